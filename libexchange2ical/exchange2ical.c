@@ -162,6 +162,179 @@ static void exchange2ical_reset(struct exchange2ical *exchange2ical)
 }
 
 
+/* Appointment columns. The same array of tags is set on the calendar
+   table and requested with GetProps, every property is therefore found
+   at a fixed slot of the row, whichever way it was fetched */
+enum exchange2ical_column {
+	E2I_FID,
+	E2I_MID,
+	E2I_GLOBALOBJECTID,
+	E2I_KEYWORDS,
+	E2I_RECURRING,
+	E2I_APPOINTMENTSTATEFLAGS,
+	E2I_TIMEZONEDESCRIPTION,
+	E2I_TIMEZONESTRUCT,
+	E2I_CONTACTS,
+	E2I_APPOINTMENTSTARTWHOLE,
+	E2I_APPOINTMENTENDWHOLE,
+	E2I_APPOINTMENTSUBTYPE,
+	E2I_OWNERCRITICALCHANGE,
+	E2I_LOCATION,
+	E2I_EXCEPTIONREPLACETIME,
+	E2I_NONSENDABLEBCC,
+	E2I_APPOINTMENTSEQUENCE,
+	E2I_BUSYSTATUS,
+	E2I_INTENDEDBUSYSTATUS,
+	E2I_ATTENDEECRITICALCHANGE,
+	E2I_APPOINTMENTREPLYTIME,
+	E2I_APPOINTMENTNOTALLOWPROPOSE,
+	E2I_ALLOWEXTERNALCHECK,
+	E2I_APPOINTMENTLASTSEQUENCE,
+	E2I_APPOINTMENTSEQUENCETIME,
+	E2I_AUTOFILLLOCATION,
+	E2I_AUTOSTARTCHECK,
+	E2I_COLLABORATEDOC,
+	E2I_CONFERENCINGCHECK,
+	E2I_CONFERENCINGTYPE,
+	E2I_DIRECTORY,
+	E2I_MEETINGWORKSPACEURL,
+	E2I_NETSHOWURL,
+	E2I_ONLINEPASSWORD,
+	E2I_ORGANIZERALIAS,
+	E2I_REMINDERSET,
+	E2I_REMINDERDELTA,
+	E2I_RESPONSESTATUS,
+	E2I_FEXCEPTIONALBODY,
+	E2I_MESSAGE_CLASS,
+	E2I_SENSITIVITY,
+	E2I_CREATION_TIME,
+	E2I_LAST_MODIFICATION_TIME,
+	E2I_IMPORTANCE,
+	E2I_RESPONSE_REQUESTED,
+	E2I_SUBJECT,
+	E2I_OWNER_APPT_ID,
+	E2I_SENDER_NAME,
+	E2I_SENDER_EMAIL_ADDRESS,
+	E2I_MESSAGE_LOCALE_ID,
+	/* long properties, truncated in tables and fetched from the message */
+	E2I_BODY,
+	E2I_APPOINTMENTRECUR,
+	E2I_COLUMN_COUNT
+};
+
+#define	E2I_TABLE_COLUMN_COUNT	E2I_BODY
+
+#define	E2I_APPOINTMENT		0x1	/* read from appointments */
+#define	E2I_EXCEPTION		0x2	/* read from embedded exception messages */
+#define	E2I_BOTH		(E2I_APPOINTMENT | E2I_EXCEPTION)
+
+static const struct {
+	uint32_t	proptag;
+	uint8_t		flags;
+} exchange2ical_columns[E2I_COLUMN_COUNT] = {
+	[E2I_FID] = { PR_FID, E2I_APPOINTMENT },
+	[E2I_MID] = { PR_MID, E2I_APPOINTMENT },
+	[E2I_GLOBALOBJECTID] = { PidLidGlobalObjectId, E2I_APPOINTMENT },
+	[E2I_KEYWORDS] = { PidNameKeywords, E2I_APPOINTMENT },
+	[E2I_RECURRING] = { PidLidRecurring, E2I_BOTH },
+	[E2I_APPOINTMENTSTATEFLAGS] = { PidLidAppointmentStateFlags, E2I_BOTH },
+	[E2I_TIMEZONEDESCRIPTION] = { PidLidTimeZoneDescription, E2I_BOTH },
+	[E2I_TIMEZONESTRUCT] = { PidLidTimeZoneStruct, E2I_BOTH },
+	[E2I_CONTACTS] = { PidLidContacts, E2I_APPOINTMENT },
+	[E2I_APPOINTMENTSTARTWHOLE] = { PidLidAppointmentStartWhole, E2I_BOTH },
+	[E2I_APPOINTMENTENDWHOLE] = { PidLidAppointmentEndWhole, E2I_BOTH },
+	[E2I_APPOINTMENTSUBTYPE] = { PidLidAppointmentSubType, E2I_BOTH },
+	[E2I_OWNERCRITICALCHANGE] = { PidLidOwnerCriticalChange, E2I_BOTH },
+	[E2I_LOCATION] = { PidLidLocation, E2I_BOTH },
+	[E2I_EXCEPTIONREPLACETIME] = { PidLidExceptionReplaceTime, E2I_EXCEPTION },
+	[E2I_NONSENDABLEBCC] = { PidLidNonSendableBcc, E2I_BOTH },
+	[E2I_APPOINTMENTSEQUENCE] = { PidLidAppointmentSequence, E2I_BOTH },
+	[E2I_BUSYSTATUS] = { PidLidBusyStatus, E2I_BOTH },
+	[E2I_INTENDEDBUSYSTATUS] = { PidLidIntendedBusyStatus, E2I_BOTH },
+	[E2I_ATTENDEECRITICALCHANGE] = { PidLidAttendeeCriticalChange, E2I_BOTH },
+	[E2I_APPOINTMENTREPLYTIME] = { PidLidAppointmentReplyTime, E2I_BOTH },
+	[E2I_APPOINTMENTNOTALLOWPROPOSE] = { PidLidAppointmentNotAllowPropose, E2I_BOTH },
+	[E2I_ALLOWEXTERNALCHECK] = { PidLidAllowExternalCheck, E2I_BOTH },
+	[E2I_APPOINTMENTLASTSEQUENCE] = { PidLidAppointmentLastSequence, E2I_BOTH },
+	[E2I_APPOINTMENTSEQUENCETIME] = { PidLidAppointmentSequenceTime, E2I_BOTH },
+	[E2I_AUTOFILLLOCATION] = { PidLidAutoFillLocation, E2I_BOTH },
+	[E2I_AUTOSTARTCHECK] = { PidLidAutoStartCheck, E2I_BOTH },
+	[E2I_COLLABORATEDOC] = { PidLidCollaborateDoc, E2I_BOTH },
+	[E2I_CONFERENCINGCHECK] = { PidLidConferencingCheck, E2I_BOTH },
+	[E2I_CONFERENCINGTYPE] = { PidLidConferencingType, E2I_BOTH },
+	[E2I_DIRECTORY] = { PidLidDirectory, E2I_BOTH },
+	[E2I_MEETINGWORKSPACEURL] = { PidLidMeetingWorkspaceUrl, E2I_APPOINTMENT },
+	[E2I_NETSHOWURL] = { PidLidNetShowUrl, E2I_BOTH },
+	[E2I_ONLINEPASSWORD] = { PidLidOnlinePassword, E2I_BOTH },
+	[E2I_ORGANIZERALIAS] = { PidLidOrganizerAlias, E2I_BOTH },
+	[E2I_REMINDERSET] = { PidLidReminderSet, E2I_BOTH },
+	[E2I_REMINDERDELTA] = { PidLidReminderDelta, E2I_BOTH },
+	[E2I_RESPONSESTATUS] = { PidLidResponseStatus, E2I_APPOINTMENT },
+	[E2I_FEXCEPTIONALBODY] = { PidLidFExceptionalBody, E2I_EXCEPTION },
+	[E2I_MESSAGE_CLASS] = { PR_MESSAGE_CLASS_UNICODE, E2I_BOTH },
+	[E2I_SENSITIVITY] = { PR_SENSITIVITY, E2I_APPOINTMENT },
+	[E2I_CREATION_TIME] = { PR_CREATION_TIME, E2I_BOTH },
+	[E2I_LAST_MODIFICATION_TIME] = { PR_LAST_MODIFICATION_TIME, E2I_BOTH },
+	[E2I_IMPORTANCE] = { PR_IMPORTANCE, E2I_BOTH },
+	[E2I_RESPONSE_REQUESTED] = { PR_RESPONSE_REQUESTED, E2I_BOTH },
+	[E2I_SUBJECT] = { PR_SUBJECT_UNICODE, E2I_BOTH },
+	[E2I_OWNER_APPT_ID] = { PR_OWNER_APPT_ID, E2I_BOTH },
+	[E2I_SENDER_NAME] = { PR_SENDER_NAME, E2I_BOTH },
+	[E2I_SENDER_EMAIL_ADDRESS] = { PR_SENDER_EMAIL_ADDRESS, E2I_BOTH },
+	[E2I_MESSAGE_LOCALE_ID] = { PR_MESSAGE_LOCALE_ID, E2I_BOTH },
+	[E2I_BODY] = { PR_BODY_UNICODE, E2I_BOTH },
+	[E2I_APPOINTMENTRECUR] = { PidLidAppointmentRecur, E2I_BOTH },
+};
+
+
+static struct SPropTagArray *exchange2ical_column_tags(TALLOC_CTX *mem_ctx, uint32_t count)
+{
+	struct SPropTagArray	*SPropTagArray;
+	uint32_t		i;
+
+	SPropTagArray = talloc_zero(mem_ctx, struct SPropTagArray);
+	if (!SPropTagArray) return NULL;
+	SPropTagArray->cValues = count;
+	SPropTagArray->aulPropTag = talloc_array(SPropTagArray, enum MAPITAGS, count);
+	if (!SPropTagArray->aulPropTag) {
+		talloc_free(SPropTagArray);
+		return NULL;
+	}
+	for (i = 0; i < count; i++) {
+		SPropTagArray->aulPropTag[i] = (enum MAPITAGS) exchange2ical_columns[i].proptag;
+	}
+
+	return SPropTagArray;
+}
+
+
+/* Return the value of a column, NULL if it is missing or has another
+   type, as error values and unresolved named properties do */
+static const void *exchange2ical_value(struct SRow *aRow, enum exchange2ical_column column)
+{
+	if (column >= aRow->cValues) return NULL;
+	if ((aRow->lpProps[column].ulPropTag & 0xFFFF) != (exchange2ical_columns[column].proptag & 0xFFFF)) {
+		return NULL;
+	}
+
+	return get_SPropValue_data(&aRow->lpProps[column]);
+}
+
+
+/* Hide the columns not read from a kind of message */
+static void exchange2ical_mask_row(struct SRow *aRow, uint8_t flags)
+{
+	uint32_t	i;
+
+	for (i = 0; i < aRow->cValues && i < E2I_COLUMN_COUNT; i++) {
+		if (!(exchange2ical_columns[i].flags & flags)) {
+			aRow->lpProps[i].ulPropTag = (enum MAPITAGS) ((aRow->lpProps[i].ulPropTag & 0xFFFF0000) | PT_ERROR);
+			aRow->lpProps[i].value.err = MAPI_E_NOT_FOUND;
+		}
+	}
+}
+
+
 static int exchange2ical_get_properties(TALLOC_CTX *mem_ctx, struct SRow *aRow, struct exchange2ical *exchange2ical, enum exchange2ical_flags eFlags)
 {
 	struct Binary_r	*apptrecur;
@@ -169,83 +342,83 @@ static int exchange2ical_get_properties(TALLOC_CTX *mem_ctx, struct SRow *aRow,
 	struct Binary_r	*TimeZoneStruct;
 
 	if(eFlags & VcalFlag){
-		messageClass = octool_get_propval(aRow, PR_MESSAGE_CLASS_UNICODE);
+		messageClass = exchange2ical_value(aRow, E2I_MESSAGE_CLASS);
 		exchange2ical->method = get_ical_method(messageClass);
 		if (!exchange2ical->method) return -1;
 	}
 	
 	if(((eFlags & RangeFlag) && !(eFlags & EntireFlag))||
 		(!(eFlags & RangeFlag) && (eFlags & EntireFlag))){
-		exchange2ical->apptStartWhole = (const struct FILETIME *)octool_get_propval(aRow, PidLidAppointmentStartWhole);
+		exchange2ical->apptStartWhole = (const struct FILETIME *)exchange2ical_value(aRow, E2I_APPOINTMENTSTARTWHOLE);
 
 	}
 	
 	if(((eFlags & EventFlag) && !(eFlags & EntireFlag))||
 		(!(eFlags & EventFlag) && (eFlags & EntireFlag))){
-		exchange2ical->GlobalObjectId = (struct Binary_r *) octool_get_propval(aRow, PidLidGlobalObjectId);
-		exchange2ical->Sequence = (uint32_t *) octool_get_propval(aRow, PidLidAppointmentSequence); 	
+		exchange2ical->GlobalObjectId = (struct Binary_r *) exchange2ical_value(aRow, E2I_GLOBALOBJECTID);
+		exchange2ical->Sequence = (uint32_t *) exchange2ical_value(aRow, E2I_APPOINTMENTSEQUENCE); 	
 
 	}
 	
 	if(((eFlags & EventsFlag) && !(eFlags & EntireFlag))||
 		(!(eFlags & EventsFlag) && (eFlags & EntireFlag))){
-		exchange2ical->GlobalObjectId = (struct Binary_r *) octool_get_propval(aRow, PidLidGlobalObjectId);
+		exchange2ical->GlobalObjectId = (struct Binary_r *) exchange2ical_value(aRow, E2I_GLOBALOBJECTID);
 
 	}
 	
 	if(eFlags & EntireFlag) {
 	  
-		apptrecur = (struct Binary_r *) octool_get_propval(aRow, PidLidAppointmentRecur);
+		apptrecur = (struct Binary_r *) exchange2ical_value(aRow, E2I_APPOINTMENTRECUR);
 		exchange2ical->AppointmentRecurrencePattern = get_AppointmentRecurrencePattern(mem_ctx,apptrecur);
 		exchange2ical->RecurrencePattern = &exchange2ical->AppointmentRecurrencePattern->RecurrencePattern;
 		
-		TimeZoneStruct = (struct Binary_r *) octool_get_propval(aRow, PidLidTimeZoneStruct);
+		TimeZoneStruct = (struct Binary_r *) exchange2ical_value(aRow, E2I_TIMEZONESTRUCT);
 		exchange2ical->TimeZoneStruct = get_TimeZoneStruct(mem_ctx, TimeZoneStruct);
 
-		exchange2ical->TimeZoneDesc = (const char *) octool_get_propval(aRow, PidLidTimeZoneDescription);
-		exchange2ical->Keywords = (const struct StringArray_r *) octool_get_propval(aRow, PidNameKeywords);
-		exchange2ical->Recurring = (uint8_t *) octool_get_propval(aRow, PidLidRecurring);
-		exchange2ical->TimeZoneDesc = (const char *) octool_get_propval(aRow, PidLidTimeZoneDescription);
-		exchange2ical->ExceptionReplaceTime = (const struct FILETIME *)octool_get_propval(aRow, PidLidExceptionReplaceTime);
-		exchange2ical->ResponseStatus = (uint32_t *) octool_get_propval(aRow, PidLidResponseStatus);
-		exchange2ical->apptStateFlags = (uint32_t *) octool_get_propval(aRow, PidLidAppointmentStateFlags);
-		exchange2ical->Contacts = (const struct StringArray_r *)octool_get_propval(aRow, PidLidContacts);
-		exchange2ical->apptEndWhole = (const struct FILETIME *)octool_get_propval(aRow, PidLidAppointmentEndWhole);	
-		exchange2ical->apptSubType = (uint8_t *) octool_get_propval(aRow, PidLidAppointmentSubType);
-		exchange2ical->OwnerCriticalChange = (const struct FILETIME *)octool_get_propval(aRow, PidLidOwnerCriticalChange);
-		exchange2ical->Location = (const char *) octool_get_propval(aRow, PidLidLocation); 	
-		exchange2ical->NonSendableBcc = (const char *) octool_get_propval(aRow, PidLidNonSendableBcc);
-		exchange2ical->BusyStatus = (uint32_t *) octool_get_propval(aRow, PidLidBusyStatus); 	
-		exchange2ical->IntendedBusyStatus = (uint32_t *) octool_get_propval(aRow, PidLidIntendedBusyStatus);	
-		exchange2ical->AttendeeCriticalChange = (const struct FILETIME *) octool_get_propval(aRow, PidLidAttendeeCriticalChange);	
-		exchange2ical->apptReplyTime = (const struct FILETIME *)octool_get_propval(aRow, PidLidAppointmentReplyTime);
-		exchange2ical->NotAllowPropose = (uint8_t *) octool_get_propval(aRow, PidLidAppointmentNotAllowPropose);	
-		exchange2ical->AllowExternCheck = (uint8_t *) octool_get_propval(aRow, PidLidAllowExternalCheck);
-		exchange2ical->apptLastSequence = (uint32_t *) octool_get_propval(aRow, PidLidAppointmentLastSequence);
-		exchange2ical->apptSeqTime = (const struct FILETIME *)octool_get_propval(aRow, PidLidAppointmentSequenceTime);	
-		exchange2ical->AutoFillLocation = (uint8_t *) octool_get_propval(aRow, PidLidAutoFillLocation);
-		exchange2ical->AutoStartCheck = (uint8_t *) octool_get_propval(aRow, PidLidAutoStartCheck);
-		exchange2ical->CollaborateDoc = (const char *) octool_get_propval(aRow, PidLidCollaborateDoc);
-		exchange2ical->ConfCheck = (uint8_t *) octool_get_propval(aRow, PidLidConferencingCheck);
-		exchange2ical->ConfType = (uint32_t *) octool_get_propval(aRow, PidLidConferencingType);
-		exchange2ical->Directory = (const char *) octool_get_propval(aRow, PidLidDirectory);
-		exchange2ical->MWSURL = (const char *) octool_get_propval(aRow, PidLidMeetingWorkspaceUrl);
-		exchange2ical->NetShowURL = (const char *) octool_get_propval(aRow, PidLidNetShowUrl);
-		exchange2ical->OnlinePassword = (const char *) octool_get_propval(aRow, PidLidOnlinePassword);
-		exchange2ical->OrgAlias = (const char *) octool_get_propval(aRow, PidLidOrganizerAlias);
-		exchange2ical->ReminderSet = (uint8_t *) octool_get_propval(aRow, PidLidReminderSet);
-		exchange2ical->ReminderDelta = (uint32_t *) octool_get_propval(aRow, PidLidReminderDelta);
-		exchange2ical->sensitivity = (uint32_t *) octool_get_propval(aRow, PR_SENSITIVITY);
-		exchange2ical->created = (const struct FILETIME *)octool_get_propval(aRow, PR_CREATION_TIME);
-		exchange2ical->body = (const char *)octool_get_propval(aRow, PR_BODY_UNICODE);
-		exchange2ical->LastModified = (const struct FILETIME *)octool_get_propval(aRow, PR_LAST_MODIFICATION_TIME);
-		exchange2ical->Importance = (uint32_t *) octool_get_propval(aRow, PR_IMPORTANCE);
-		exchange2ical->ResponseRequested = (uint8_t *) octool_get_propval(aRow, PR_RESPONSE_REQUESTED);
-		exchange2ical->Subject = (const char *) octool_get_propval(aRow, PR_SUBJECT_UNICODE);
-		exchange2ical->MessageLocaleId = (uint32_t *) octool_get_propval(aRow, PR_MESSAGE_LOCALE_ID);
-		exchange2ical->OwnerApptId = (uint32_t *) octool_get_propval(aRow, PR_OWNER_APPT_ID);
-		exchange2ical->SenderName = (const char *) octool_get_propval(aRow, PR_SENDER_NAME);
-		exchange2ical->SenderEmailAddress = (const char *) octool_get_propval(aRow, PR_SENDER_EMAIL_ADDRESS);
+		exchange2ical->TimeZoneDesc = (const char *) exchange2ical_value(aRow, E2I_TIMEZONEDESCRIPTION);
+		exchange2ical->Keywords = (const struct StringArray_r *) exchange2ical_value(aRow, E2I_KEYWORDS);
+		exchange2ical->Recurring = (uint8_t *) exchange2ical_value(aRow, E2I_RECURRING);
+		exchange2ical->TimeZoneDesc = (const char *) exchange2ical_value(aRow, E2I_TIMEZONEDESCRIPTION);
+		exchange2ical->ExceptionReplaceTime = (const struct FILETIME *)exchange2ical_value(aRow, E2I_EXCEPTIONREPLACETIME);
+		exchange2ical->ResponseStatus = (uint32_t *) exchange2ical_value(aRow, E2I_RESPONSESTATUS);
+		exchange2ical->apptStateFlags = (uint32_t *) exchange2ical_value(aRow, E2I_APPOINTMENTSTATEFLAGS);
+		exchange2ical->Contacts = (const struct StringArray_r *)exchange2ical_value(aRow, E2I_CONTACTS);
+		exchange2ical->apptEndWhole = (const struct FILETIME *)exchange2ical_value(aRow, E2I_APPOINTMENTENDWHOLE);	
+		exchange2ical->apptSubType = (uint8_t *) exchange2ical_value(aRow, E2I_APPOINTMENTSUBTYPE);
+		exchange2ical->OwnerCriticalChange = (const struct FILETIME *)exchange2ical_value(aRow, E2I_OWNERCRITICALCHANGE);
+		exchange2ical->Location = (const char *) exchange2ical_value(aRow, E2I_LOCATION); 	
+		exchange2ical->NonSendableBcc = (const char *) exchange2ical_value(aRow, E2I_NONSENDABLEBCC);
+		exchange2ical->BusyStatus = (uint32_t *) exchange2ical_value(aRow, E2I_BUSYSTATUS); 	
+		exchange2ical->IntendedBusyStatus = (uint32_t *) exchange2ical_value(aRow, E2I_INTENDEDBUSYSTATUS);	
+		exchange2ical->AttendeeCriticalChange = (const struct FILETIME *) exchange2ical_value(aRow, E2I_ATTENDEECRITICALCHANGE);	
+		exchange2ical->apptReplyTime = (const struct FILETIME *)exchange2ical_value(aRow, E2I_APPOINTMENTREPLYTIME);
+		exchange2ical->NotAllowPropose = (uint8_t *) exchange2ical_value(aRow, E2I_APPOINTMENTNOTALLOWPROPOSE);	
+		exchange2ical->AllowExternCheck = (uint8_t *) exchange2ical_value(aRow, E2I_ALLOWEXTERNALCHECK);
+		exchange2ical->apptLastSequence = (uint32_t *) exchange2ical_value(aRow, E2I_APPOINTMENTLASTSEQUENCE);
+		exchange2ical->apptSeqTime = (const struct FILETIME *)exchange2ical_value(aRow, E2I_APPOINTMENTSEQUENCETIME);	
+		exchange2ical->AutoFillLocation = (uint8_t *) exchange2ical_value(aRow, E2I_AUTOFILLLOCATION);
+		exchange2ical->AutoStartCheck = (uint8_t *) exchange2ical_value(aRow, E2I_AUTOSTARTCHECK);
+		exchange2ical->CollaborateDoc = (const char *) exchange2ical_value(aRow, E2I_COLLABORATEDOC);
+		exchange2ical->ConfCheck = (uint8_t *) exchange2ical_value(aRow, E2I_CONFERENCINGCHECK);
+		exchange2ical->ConfType = (uint32_t *) exchange2ical_value(aRow, E2I_CONFERENCINGTYPE);
+		exchange2ical->Directory = (const char *) exchange2ical_value(aRow, E2I_DIRECTORY);
+		exchange2ical->MWSURL = (const char *) exchange2ical_value(aRow, E2I_MEETINGWORKSPACEURL);
+		exchange2ical->NetShowURL = (const char *) exchange2ical_value(aRow, E2I_NETSHOWURL);
+		exchange2ical->OnlinePassword = (const char *) exchange2ical_value(aRow, E2I_ONLINEPASSWORD);
+		exchange2ical->OrgAlias = (const char *) exchange2ical_value(aRow, E2I_ORGANIZERALIAS);
+		exchange2ical->ReminderSet = (uint8_t *) exchange2ical_value(aRow, E2I_REMINDERSET);
+		exchange2ical->ReminderDelta = (uint32_t *) exchange2ical_value(aRow, E2I_REMINDERDELTA);
+		exchange2ical->sensitivity = (uint32_t *) exchange2ical_value(aRow, E2I_SENSITIVITY);
+		exchange2ical->created = (const struct FILETIME *)exchange2ical_value(aRow, E2I_CREATION_TIME);
+		exchange2ical->body = (const char *)exchange2ical_value(aRow, E2I_BODY);
+		exchange2ical->LastModified = (const struct FILETIME *)exchange2ical_value(aRow, E2I_LAST_MODIFICATION_TIME);
+		exchange2ical->Importance = (uint32_t *) exchange2ical_value(aRow, E2I_IMPORTANCE);
+		exchange2ical->ResponseRequested = (uint8_t *) exchange2ical_value(aRow, E2I_RESPONSE_REQUESTED);
+		exchange2ical->Subject = (const char *) exchange2ical_value(aRow, E2I_SUBJECT);
+		exchange2ical->MessageLocaleId = (uint32_t *) exchange2ical_value(aRow, E2I_MESSAGE_LOCALE_ID);
+		exchange2ical->OwnerApptId = (uint32_t *) exchange2ical_value(aRow, E2I_OWNER_APPT_ID);
+		exchange2ical->SenderName = (const char *) exchange2ical_value(aRow, E2I_SENDER_NAME);
+		exchange2ical->SenderEmailAddress = (const char *) exchange2ical_value(aRow, E2I_SENDER_EMAIL_ADDRESS);
 	}
 	
 	return 0;
@@ -456,62 +629,15 @@ static uint8_t exchange2ical_exception_from_EmbeddedObj(struct exchange2ical *ex
 						if (retval != MAPI_E_SUCCESS) {
 							return 1;
 						}else {							
- 							SPropTagArray = set_SPropTagArray(exchange2ical->mem_ctx, 0x2d,
-												PidLidFExceptionalBody,
-												PidLidRecurring,
-												PidLidAppointmentRecur,
-												PidLidAppointmentStateFlags,
-												PidLidTimeZoneDescription,
-												PidLidTimeZoneStruct,
-												PidLidAppointmentStartWhole,
-												PidLidAppointmentEndWhole,
-												PidLidAppointmentSubType,
-												PidLidOwnerCriticalChange,
-												PidLidLocation,
-												PidLidExceptionReplaceTime,
-												PidLidNonSendableBcc,
-												PidLidAppointmentSequence,
-												PidLidBusyStatus,
-												PidLidIntendedBusyStatus,
-												PidLidCleanGlobalObjectId,
-												PidLidAttendeeCriticalChange,
-												PidLidAppointmentReplyTime,
-												PidLidAppointmentNotAllowPropose,
-												PidLidAllowExternalCheck,
-												PidLidAppointmentLastSequence,
-												PidLidAppointmentSequenceTime,
-												PidLidAutoFillLocation,
-												PidLidAutoStartCheck,
-												PidLidCollaborateDoc,
-												PidLidConferencingCheck,
-												PidLidConferencingType,
-												PidLidDirectory,
-												PidLidNetShowUrl,
-												PidLidOnlinePassword,
-												PidLidOrganizerAlias,
-												PidLidReminderSet,
-												PidLidReminderDelta,
-												PR_MESSAGE_CLASS_UNICODE,
-												PR_BODY_UNICODE,
-												PR_CREATION_TIME,
-												PR_LAST_MODIFICATION_TIME,
-												PR_IMPORTANCE,
-												PR_RESPONSE_REQUESTED,
-												PR_SUBJECT_UNICODE,
-												PR_OWNER_APPT_ID,
-												PR_SENDER_NAME,
-												PR_SENDER_EMAIL_ADDRESS,
-												PR_MESSAGE_LOCALE_ID
- 								  );
-								  
-								  
-		
+							SPropTagArray = exchange2ical_column_tags(exchange2ical->mem_ctx, E2I_COLUMN_COUNT);
 							retval = GetProps(&exception.obj_message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
+							MAPIFreeBuffer(SPropTagArray);
 							
 							if (retval == MAPI_E_SUCCESS) {	
 								aRow2.ulAdrEntryPad = 0;
 								aRow2.cValues = count;
 								aRow2.lpProps = lpProps;
+								exchange2ical_mask_row(&aRow2, E2I_EXCEPTION);
 								
 								
 								/*Get required properties to check if right event*/
@@ -524,7 +650,7 @@ static uint8_t exchange2ical_exception_from_EmbeddedObj(struct exchange2ical *ex
 
 								/*Grab Rest of Properties*/
 								exchange2ical_get_properties(exchange2ical->mem_ctx, &aRow2, &exception, exchange2ical_check->eFlags | EntireFlag);
-								uint8_t *dBody = (uint8_t *) octool_get_propval(&aRow2, PidLidFExceptionalBody);
+								uint8_t *dBody = (uint8_t *) exchange2ical_value(&aRow2, E2I_FEXCEPTIONALBODY);
 								retval = GetRecipientTable(&exception.obj_message, 
 									&exception.Recipients.SRowSet,
 									&exception.Recipients.SPropTagArray);
@@ -591,19 +717,153 @@ static uint8_t exchange2ical_exception_from_EmbeddedObj(struct exchange2ical *ex
 	return 0;	
 }
 
+/*
+ * SetColumns does not resolve named properties as GetProps does. Names
+ * unknown to the server are replaced by PR_MID, whose type does not
+ * match and hides the column
+ */
+static enum MAPISTATUS exchange2ical_map_columns(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder,
+						 struct SPropTagArray *SPropTagArray)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_nameid	*nameid;
+	struct SPropTagArray	*SPropTagArray2;
+	uint32_t		i;
+
+	nameid = mapi_nameid_new(mem_ctx);
+	if (!nameid) return MAPI_E_NOT_ENOUGH_MEMORY;
+
+	if (mapi_nameid_lookup_SPropTagArray(nameid, SPropTagArray) == MAPI_E_SUCCESS) {
+		SPropTagArray2 = talloc_zero(mem_ctx, struct SPropTagArray);
+		retval = GetIDsFromNames(obj_folder, nameid->count, nameid->nameid, 0, &SPropTagArray2);
+		if (retval != MAPI_E_SUCCESS && retval != MAPI_W_ERRORS_RETURNED) {
+			talloc_free(nameid);
+			return retval;
+		}
+		mapi_nameid_map_SPropTagArray(nameid, SPropTagArray, SPropTagArray2);
+		MAPIFreeBuffer(SPropTagArray2);
+	}
+	talloc_free(nameid);
+
+	for (i = 0; i < SPropTagArray->cValues; i++) {
+		if (!(SPropTagArray->aulPropTag[i] & 0xFFFF0000)) {
+			SPropTagArray->aulPropTag[i] = PR_MID;
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/*
+ * Read the properties an appointment is filtered on, creating the
+ * vcalendar with the first one, and tell whether it is converted
+ */
+static bool exchange2ical_accept(TALLOC_CTX *mem_ctx, struct SRow *aRow,
+				 struct exchange2ical *exchange2ical,
+				 struct exchange2ical_check *exchange2ical_check)
+{
+	/*Get Vcal info if first event*/
+	if(!exchange2ical->vcalendar){
+		exchange2ical_get_properties(mem_ctx, aRow, exchange2ical, VcalFlag);
+		/*TODO: exit nicely*/
+		ical_component_VCALENDAR(exchange2ical);
+	}
+
+	/*Get required properties to check if right event*/
+	exchange2ical_get_properties(mem_ctx, aRow, exchange2ical, exchange2ical_check->eFlags);
+
+	/*Check to see if event is acceptable*/
+	return checkEvent(exchange2ical, exchange2ical_check, get_tm_from_FILETIME(exchange2ical->apptStartWhole));
+}
+
+/*
+ * Convert the appointment opened in exchange2ical->obj_message, whose
+ * columns are in aRow, into VEVENTs of exchange2ical->vcalendar
+ */
+static void exchange2ical_convert(TALLOC_CTX *mem_ctx, struct SRow *aRow,
+				  struct exchange2ical *exchange2ical,
+				  struct exchange2ical_check *exchange2ical_check)
+{
+	enum MAPISTATUS			retval;
+	int				ret;
+	struct SRow			aRowT;
+	struct SPropValue		*lpProps = NULL;
+	struct SPropTagArray		*SPropTagArray;
+	const uint8_t			*recurring;
+	uint32_t			count;
+	uint32_t			i;
+
+	/*Set RecipientTable*/
+	retval = GetRecipientTable(&exchange2ical->obj_message, 
+				   &exchange2ical->Recipients.SRowSet,
+				   &exchange2ical->Recipients.SPropTagArray);
+
+	/*Set PR_BODY_HTML for x_alt_desc property, together with the long
+	  properties the table did not return. The recurrence blob is only
+	  needed by recurring appointments*/
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x1, PR_BODY_HTML_UNICODE);
+	if (!exchange2ical_value(aRow, E2I_BODY)) {
+		SPropTagArray_add(mem_ctx, SPropTagArray, exchange2ical_columns[E2I_BODY].proptag);
+	}
+	recurring = (const uint8_t *) exchange2ical_value(aRow, E2I_RECURRING);
+	if (!exchange2ical_value(aRow, E2I_APPOINTMENTRECUR) && recurring && *recurring) {
+		SPropTagArray_add(mem_ctx, SPropTagArray, exchange2ical_columns[E2I_APPOINTMENTRECUR].proptag);
+	}
+	retval = GetProps(&exchange2ical->obj_message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
+	if (retval == MAPI_E_SUCCESS) {
+		aRowT.ulAdrEntryPad = 0;
+		aRowT.cValues = count;
+		aRowT.lpProps = lpProps;
+		exchange2ical->bodyHTML = (const char *)octool_get_propval(&aRowT, PR_BODY_HTML_UNICODE);
+
+		for (i = 1; i < count && i < SPropTagArray->cValues && aRow->cValues == E2I_COLUMN_COUNT; i++) {
+			if (SPropTagArray->aulPropTag[i] == exchange2ical_columns[E2I_BODY].proptag) {
+				aRow->lpProps[E2I_BODY] = lpProps[i];
+			} else {
+				aRow->lpProps[E2I_APPOINTMENTRECUR] = lpProps[i];
+			}
+		}
+	} else {
+		lpProps = NULL;
+	}
+	MAPIFreeBuffer(SPropTagArray);
+
+	/*Get rest of properties*/
+	ret = exchange2ical_get_properties(mem_ctx, aRow, exchange2ical, (exchange2ical_check->eFlags | EntireFlag));
+
+	/*add new vevent*/
+	ical_component_VEVENT(exchange2ical);
+
+	/*Exceptions to event, only looked for in the attachments when the
+	  recurrence blob has modified instances*/
+	if(exchange2ical_check->eFlags != EventFlag &&
+	   exchange2ical->AppointmentRecurrencePattern &&
+	   exchange2ical->AppointmentRecurrencePattern->ExceptionCount){
+		ret = exchange2ical_exception_from_EmbeddedObj(exchange2ical, exchange2ical_check);
+		if (ret){
+			ret=exchange2ical_exception_from_ExceptionInfo(exchange2ical, exchange2ical_check);
+		}
+	}
+
+	/*REMOVE once globalobjid is fixed*/
+	exchange2ical->idx++;
+
+	MAPIFreeBuffer(lpProps);
+	exchange2ical_reset(exchange2ical);
+}
+
 icalcomponent * _Exchange2Ical(mapi_object_t *obj_folder, struct exchange2ical_check *exchange2ical_check)
 {
 	TALLOC_CTX			*mem_ctx;
 	enum MAPISTATUS			retval;
-	int				ret;
 	struct SRowSet			SRowSet;
 	struct SRow			aRow;
-	struct SRow			aRowT;
-	struct SPropValue		*lpProps;
+	struct SPropValue		lpProps[E2I_COLUMN_COUNT];
 	struct SPropTagArray		*SPropTagArray = NULL;
 	struct exchange2ical		exchange2ical;
 	mapi_object_t			obj_table;
 	uint32_t			count;
+	uint32_t			j;
 	int				i;
 
 	mem_ctx = talloc_named(mapi_object_get_session(obj_folder), 0, "exchange2ical");
@@ -623,11 +883,17 @@ icalcomponent * _Exchange2Ical(mapi_object_t *obj_folder, struct exchange2ical_c
 		return NULL;
 	}
 
-	SPropTagArray = set_SPropTagArray(mem_ctx, 0x2,
-					  PR_FID,
-					  PR_MID);
-					  
-	retval = SetColumns(&obj_table, SPropTagArray);
+	/* Read the appointments from the table rather than one GetProps
+	   per message, only the long properties are fetched later */
+	SPropTagArray = exchange2ical_column_tags(mem_ctx, E2I_TABLE_COLUMN_COUNT);
+	if (!SPropTagArray) {
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+	retval = exchange2ical_map_columns(mem_ctx, obj_folder, SPropTagArray);
+	if (retval == MAPI_E_SUCCESS) {
+		retval = SetColumns(&obj_table, SPropTagArray);
+	}
 	MAPIFreeBuffer(SPropTagArray);
 	if (retval != MAPI_E_SUCCESS) {
 		mapi_errstr("SetColumns", retval);
@@ -638,126 +904,30 @@ icalcomponent * _Exchange2Ical(mapi_object_t *obj_folder, struct exchange2ical_c
 	while ((retval = QueryRows(&obj_table, count, TBL_ADVANCE, TBL_FORWARD_READ, &SRowSet)) != MAPI_E_NOT_FOUND && SRowSet.cRows) {
 		count -= SRowSet.cRows;
 		for (i = (SRowSet.cRows-1); i >= 0; i--) {
+			if (SRowSet.aRow[i].cValues < E2I_TABLE_COLUMN_COUNT) continue;
+
+			memcpy(lpProps, SRowSet.aRow[i].lpProps, E2I_TABLE_COLUMN_COUNT * sizeof (struct SPropValue));
+			for (j = E2I_TABLE_COLUMN_COUNT; j < E2I_COLUMN_COUNT; j++) {
+				lpProps[j].ulPropTag = (enum MAPITAGS) PT_ERROR;
+				lpProps[j].value.err = MAPI_E_NOT_FOUND;
+			}
+			aRow.ulAdrEntryPad = 0;
+			aRow.cValues = E2I_COLUMN_COUNT;
+			aRow.lpProps = lpProps;
+			exchange2ical_mask_row(&aRow, E2I_APPOINTMENT);
+
+			/* Appointments filtered out are not opened */
+			if (!exchange2ical_accept(mem_ctx, &aRow, &exchange2ical, exchange2ical_check)) {
+				continue;
+			}
+
 			mapi_object_init(&exchange2ical.obj_message);
 			retval = OpenMessage(obj_folder,
-					     SRowSet.aRow[i].lpProps[0].value.d,
-					     SRowSet.aRow[i].lpProps[1].value.d,
+					     lpProps[E2I_FID].value.d,
+					     lpProps[E2I_MID].value.d,
 					     &exchange2ical.obj_message, 0);
-			if (retval != MAPI_E_NOT_FOUND) {
-				SPropTagArray = set_SPropTagArray(mem_ctx, 0x30,
-								  PidLidGlobalObjectId,
-								  PidNameKeywords,
-								  PidLidRecurring,
-								  PidLidAppointmentRecur,
-								  PidLidAppointmentStateFlags,
-								  PidLidTimeZoneDescription,
-								  PidLidTimeZoneStruct,
-								  PidLidContacts,
-								  PidLidAppointmentStartWhole,
-								  PidLidAppointmentEndWhole,
-								  PidLidAppointmentSubType,
-								  PidLidOwnerCriticalChange,
-								  PidLidLocation,
-								  PidLidNonSendableBcc,
-								  PidLidAppointmentSequence,
-								  PidLidBusyStatus,
-								  PidLidIntendedBusyStatus,
-								  PidLidAttendeeCriticalChange,
-								  PidLidAppointmentReplyTime,
-								  PidLidAppointmentNotAllowPropose,
-								  PidLidAllowExternalCheck,
-								  PidLidAppointmentLastSequence,
-								  PidLidAppointmentSequenceTime,
-								  PidLidAutoFillLocation,
-								  PidLidAutoStartCheck,
-								  PidLidCollaborateDoc,
-								  PidLidConferencingCheck,
-								  PidLidConferencingType,
-								  PidLidDirectory,
-								  PidLidMeetingWorkspaceUrl,
-								  PidLidNetShowUrl,
-								  PidLidOnlinePassword,
-								  PidLidOrganizerAlias,
-								  PidLidReminderSet,
-								  PidLidReminderDelta,
-								  PidLidResponseStatus,
-								  PR_MESSAGE_CLASS_UNICODE,
-								  PR_SENSITIVITY,
-								  PR_BODY_UNICODE,
-								  PR_CREATION_TIME,
-								  PR_LAST_MODIFICATION_TIME,
-								  PR_IMPORTANCE,
-								  PR_RESPONSE_REQUESTED,
-								  PR_SUBJECT_UNICODE,
-								  PR_OWNER_APPT_ID,
-								  PR_SENDER_NAME,
-								  PR_SENDER_EMAIL_ADDRESS,
-								  PR_MESSAGE_LOCALE_ID
-								  );
-								  
-								  
-				retval = GetProps(&exchange2ical.obj_message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
-
-				MAPIFreeBuffer(SPropTagArray);
-	
-				if (retval == MAPI_E_SUCCESS) {
-					aRow.ulAdrEntryPad = 0;
-					aRow.cValues = count;
-					aRow.lpProps = lpProps;
-					
-					/*Get Vcal info if first event*/
-					if(i==(SRowSet.cRows-1)){
-						ret = exchange2ical_get_properties(mem_ctx, &aRow, &exchange2ical, VcalFlag);
-						/*TODO: exit nicely*/
-						ical_component_VCALENDAR(&exchange2ical);
-					}
-					
-					
-					/*Get required properties to check if right event*/
-					ret = exchange2ical_get_properties(mem_ctx, &aRow, &exchange2ical, exchange2ical_check->eFlags);
-					
-					/*Check to see if event is acceptable*/
-					if (!checkEvent(&exchange2ical, exchange2ical_check, get_tm_from_FILETIME(exchange2ical.apptStartWhole))){
-						continue;
-					}
-					
-					/*Set RecipientTable*/
-					retval = GetRecipientTable(&exchange2ical.obj_message, 
-							   &exchange2ical.Recipients.SRowSet,
-							   &exchange2ical.Recipients.SPropTagArray);
-					
-					/*Set PR_BODY_HTML for x_alt_desc property*/
-					SPropTagArray = set_SPropTagArray(mem_ctx, 0x1, PR_BODY_HTML_UNICODE);
-					retval = GetProps(&exchange2ical.obj_message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
-					MAPIFreeBuffer(SPropTagArray);
-					if (retval == MAPI_E_SUCCESS) {
-						aRowT.ulAdrEntryPad = 0;
-						aRowT.cValues = count;
-						aRowT.lpProps = lpProps;
-						exchange2ical.bodyHTML = (const char *)octool_get_propval(&aRowT, PR_BODY_HTML_UNICODE);
-					}
-					
-					/*Get rest of properties*/
-					ret = exchange2ical_get_properties(mem_ctx, &aRow, &exchange2ical, (exchange2ical_check->eFlags | EntireFlag));
-					
-					/*add new vevent*/
-					ical_component_VEVENT(&exchange2ical);
-					
-					/*Exceptions to event*/
-					if(exchange2ical_check->eFlags != EventFlag){
-						ret = exchange2ical_exception_from_EmbeddedObj(&exchange2ical, exchange2ical_check);
-						if (ret){
-							ret=exchange2ical_exception_from_ExceptionInfo(&exchange2ical, exchange2ical_check);
-						}
-					}
-					
-					/*REMOVE once globalobjid is fixed*/
-					exchange2ical.idx++;
-					
-					MAPIFreeBuffer(lpProps);
-					exchange2ical_reset(&exchange2ical);
-				}
-				
+			if (retval == MAPI_E_SUCCESS) {
+				exchange2ical_convert(mem_ctx, &aRow, &exchange2ical, exchange2ical_check);
 			}
 			mapi_object_release(&exchange2ical.obj_message);
 		}
@@ -771,3 +941,42 @@ icalcomponent * _Exchange2Ical(mapi_object_t *obj_folder, struct exchange2ical_c
 	talloc_free(mem_ctx);	
 	return icalendar;
 }
+
+icalcomponent * _Exchange2IcalMessage(mapi_object_t *obj_folder, mapi_id_t mid, struct exchange2ical_check *exchange2ical_check)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct SRow			aRow;
+	struct SPropValue		*lpProps;
+	struct SPropTagArray		*SPropTagArray;
+	struct exchange2ical		exchange2ical;
+	icalcomponent			*icalendar;
+	uint32_t			count;
+
+	mem_ctx = talloc_named(mapi_object_get_session(obj_folder), 0, "exchange2ical");
+	exchange2ical_init(mem_ctx, &exchange2ical);
+
+	mapi_object_init(&exchange2ical.obj_message);
+	retval = OpenMessage(obj_folder, mapi_object_get_id(obj_folder), mid, &exchange2ical.obj_message, 0);
+	if (retval == MAPI_E_SUCCESS) {
+		SPropTagArray = exchange2ical_column_tags(mem_ctx, E2I_COLUMN_COUNT);
+		retval = SPropTagArray ? GetProps(&exchange2ical.obj_message, MAPI_UNICODE, SPropTagArray, &lpProps, &count) : MAPI_E_NOT_ENOUGH_MEMORY;
+		MAPIFreeBuffer(SPropTagArray);
+		if (retval == MAPI_E_SUCCESS) {
+			aRow.ulAdrEntryPad = 0;
+			aRow.cValues = count;
+			aRow.lpProps = lpProps;
+			exchange2ical_mask_row(&aRow, E2I_APPOINTMENT);
+			if (exchange2ical_accept(mem_ctx, &aRow, &exchange2ical, exchange2ical_check)) {
+				exchange2ical_convert(mem_ctx, &aRow, &exchange2ical, exchange2ical_check);
+			}
+			MAPIFreeBuffer(lpProps);
+		}
+	}
+	mapi_object_release(&exchange2ical.obj_message);
+
+	icalendar = exchange2ical.vcalendar;
+	exchange2ical_clear(&exchange2ical);
+	talloc_free(mem_ctx);
+	return icalendar;
+}
@@ -158,6 +158,7 @@ __BEGIN_DECLS
 
 /* definitions from exchang2ical.c */
 icalcomponent * _Exchange2Ical(mapi_object_t *, struct exchange2ical_check *);
+icalcomponent * _Exchange2IcalMessage(mapi_object_t *, mapi_id_t, struct exchange2ical_check *);
 
 
 /* definitions from exchange2ical_utils.c */
@@ -325,8 +326,22 @@ struct ical2exchange{
 };
 
 
+/* Called after each chunk of events imported, total is the number of
+ * events of the calendar */
+typedef void (*ical2exchange_progress_fn)(uint32_t, uint32_t, void *);
+
+/* Outcome of the import of an event */
+struct ical2exchange_status {
+	const char			*uid;		/* UID of the VEVENT, NULL if it has none */
+	enum MAPISTATUS			retval;		/* MAPI_E_SUCCESS if its message was saved */
+};
+
+
 /*ical2exchange file*/
 void _IcalEvent2Exchange(mapi_object_t *, icalcomponent *);
+enum MAPISTATUS _IcalCalendar2Exchange(TALLOC_CTX *, mapi_object_t *, icalcomponent *,
+				       ical2exchange_progress_fn, void *,
+				       struct ical2exchange_status **, uint32_t *);
 
 
 /*ical2exchange_property*/
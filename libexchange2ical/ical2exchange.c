@@ -379,3 +379,294 @@ void _IcalEvent2Exchange(mapi_object_t *obj_folder, icalcomponent *vevent)
 	talloc_free(mem_ctx);
 
 }
+
+
+/* Events converted before their messages are written */
+#define	ICAL2EXCHANGE_BULK_CHUNK	128
+
+struct ical2exchange_bulk_event {
+	mapi_object_t		obj_message;
+	struct SPropValue	*lpProps;
+	uint32_t		cValues;
+	enum MAPISTATUS		create_status;
+	enum MAPISTATUS		set_status;
+	enum MAPISTATUS		save_status;
+};
+
+/* Named properties of the folder store resolved during an import */
+struct ical2exchange_bulk_nameid {
+	uint32_t		*proptags;	/* canonical tags */
+	uint32_t		*mapped;	/* tags returned by GetIDsFromNames */
+	uint32_t		count;
+};
+
+
+static bool ical2exchange_bulk_is_named(uint32_t proptag)
+{
+	uint16_t	propid = (proptag & 0xFFFF0000) >> 16;
+
+	return ((propid >= 0x8000) && (propid <= 0x8FFF)) ||
+		((propid >= 0xa000) && (propid <= 0xaFFF));
+}
+
+
+static bool ical2exchange_bulk_nameid_find(struct ical2exchange_bulk_nameid *cache, uint32_t proptag,
+					   uint32_t *mappedp)
+{
+	uint32_t	i;
+
+	for (i = 0; i < cache->count; i++) {
+		if (cache->proptags[i] == proptag) {
+			if (mappedp) *mappedp = cache->mapped[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+   \details Replace the named properties of an event with their tags
+   in the store
+
+   SetProps calls GetIDsFromNames on every message, only the named
+   properties not resolved for a previous event of the import are
+   looked up here.
+ */
+static enum MAPISTATUS ical2exchange_bulk_map_named(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder,
+						    struct ical2exchange_bulk_nameid *cache,
+						    struct SPropValue *lpProps, uint32_t cValues)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_nameid	*nameid;
+	struct SPropTagArray	*SPropTagArray;
+	uint32_t		mapped;
+	uint32_t		i, j;
+
+	nameid = mapi_nameid_new(mem_ctx);
+	OPENCHANGE_RETVAL_IF(!nameid, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	for (i = 0; i < cValues; i++) {
+		if (!ical2exchange_bulk_is_named(lpProps[i].ulPropTag)) continue;
+		if (ical2exchange_bulk_nameid_find(cache, lpProps[i].ulPropTag, NULL)) continue;
+		mapi_nameid_canonical_add(nameid, lpProps[i].ulPropTag);
+	}
+
+	if (nameid->count) {
+		SPropTagArray = talloc_zero(nameid, struct SPropTagArray);
+		OPENCHANGE_RETVAL_IF(!SPropTagArray, MAPI_E_NOT_ENOUGH_MEMORY, nameid);
+		retval = GetIDsFromNames(obj_folder, nameid->count, nameid->nameid, 0, &SPropTagArray);
+		OPENCHANGE_RETVAL_IF(retval, retval, nameid);
+
+		for (j = 0; j < nameid->count && j < SPropTagArray->cValues; j++) {
+			if (ical2exchange_bulk_nameid_find(cache, nameid->entries[j].proptag, NULL)) continue;
+
+			cache->proptags = talloc_realloc(mem_ctx, cache->proptags, uint32_t, cache->count + 1);
+			OPENCHANGE_RETVAL_IF(!cache->proptags, MAPI_E_NOT_ENOUGH_MEMORY, nameid);
+			cache->mapped = talloc_realloc(mem_ctx, cache->mapped, uint32_t, cache->count + 1);
+			OPENCHANGE_RETVAL_IF(!cache->mapped, MAPI_E_NOT_ENOUGH_MEMORY, nameid);
+			cache->proptags[cache->count] = nameid->entries[j].proptag;
+			cache->mapped[cache->count] = (SPropTagArray->aulPropTag[j] & 0xFFFF0000) |
+				nameid->entries[j].propType;
+			cache->count++;
+		}
+	}
+	talloc_free(nameid);
+
+	for (i = 0; i < cValues; i++) {
+		if (ical2exchange_bulk_nameid_find(cache, lpProps[i].ulPropTag, &mapped)) {
+			lpProps[i].ulPropTag = (enum MAPITAGS) mapped;
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the creation of the message of an event: create,
+   set its properties, save and release it
+ */
+static enum MAPISTATUS ical2exchange_bulk_queue_step(struct mapi_batch *batch, mapi_object_t *obj_folder,
+						     struct ical2exchange_bulk_event *event, int step)
+{
+	switch (step) {
+	case 0:
+		return mapi_batch_CreateMessage(batch, obj_folder, &event->obj_message, &event->create_status);
+	case 1:
+		return mapi_batch_SetProps(batch, &event->obj_message, event->lpProps, event->cValues,
+					   &event->set_status);
+	case 2:
+		return mapi_batch_SaveChangesMessage(batch, obj_folder, &event->obj_message, KeepOpenReadOnly,
+						     &event->save_status);
+	default:
+		return mapi_batch_Release(batch, &event->obj_message, NULL);
+	}
+}
+
+
+/**
+   \details Create a message in obj_folder for each VEVENT of an
+   Icalendar
+
+   The events are converted ICAL2EXCHANGE_BULK_CHUNK at a time and
+   their messages written through a single batch, so that importing a
+   calendar takes a few EcDoRpc calls per chunk instead of four per
+   event.
+
+   \param mem_ctx pointer to the memory context the status array is
+   allocated with
+   \param obj_folder the folder to create the messages in
+   \param vcalendar the Icalendar to import, or a single VEVENT
+   \param progress_fn function called after each chunk, may be NULL
+   \param private_data pointer passed to progress_fn
+   \param statusp pointer on pointer to the status of each event to
+   return, in the order of the Icalendar, may be NULL
+   \param countp pointer to the number of events to return, may be
+   NULL
+
+   \return MAPI_E_SUCCESS if every event was processed, whether or not
+   its message could be created, otherwise MAPI error.
+ */
+enum MAPISTATUS _IcalCalendar2Exchange(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder, icalcomponent *vcalendar,
+				       ical2exchange_progress_fn progress_fn, void *private_data,
+				       struct ical2exchange_status **statusp, uint32_t *countp)
+{
+	enum MAPISTATUS				retval;
+	TALLOC_CTX				*local_mem_ctx;
+	TALLOC_CTX				*chunk_ctx;
+	struct mapi_session			*session;
+	struct mapi_batch			*batch = NULL;
+	struct ical2exchange			ical2exchange;
+	struct ical2exchange_bulk_nameid	nameid_cache;
+	struct ical2exchange_bulk_event		*events;
+	struct ical2exchange_status		*status = NULL;
+	icalcomponent				**vevents = NULL;
+	icalcomponent				*vevent;
+	uint32_t				count = 0;
+	uint32_t				chunk_count;
+	uint32_t				i, j;
+	int					step;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!obj_folder || !vcalendar, MAPI_E_INVALID_PARAMETER, NULL);
+	session = mapi_object_get_session(obj_folder);
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_named(session, 0, "IcalCalendar2Exchange");
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	memset(&nameid_cache, 0, sizeof (struct ical2exchange_bulk_nameid));
+
+	/* Step 1. Collect the events of the calendar */
+	if (icalcomponent_isa(vcalendar) == ICAL_VEVENT_COMPONENT) {
+		vevents = talloc_array(local_mem_ctx, icalcomponent *, 1);
+		OPENCHANGE_RETVAL_IF(!vevents, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+		vevents[count++] = vcalendar;
+	} else {
+		for (vevent = icalcomponent_get_first_component(vcalendar, ICAL_VEVENT_COMPONENT); vevent;
+		     vevent = icalcomponent_get_next_component(vcalendar, ICAL_VEVENT_COMPONENT)) {
+			vevents = talloc_realloc(local_mem_ctx, vevents, icalcomponent *, count + 1);
+			OPENCHANGE_RETVAL_IF(!vevents, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+			vevents[count++] = vevent;
+		}
+	}
+
+	status = talloc_zero_array(mem_ctx, struct ical2exchange_status, count ? count : 1);
+	OPENCHANGE_RETVAL_IF(!status, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	for (i = 0; i < count; i++) {
+		icalproperty	*uidProp;
+
+		uidProp = icalcomponent_get_first_property(vevents[i], ICAL_UID_PROPERTY);
+		if (uidProp && icalproperty_get_uid(uidProp)) {
+			status[i].uid = talloc_strdup(status, icalproperty_get_uid(uidProp));
+		}
+		status[i].retval = MAPI_E_UNABLE_TO_COMPLETE;
+	}
+
+	retval = mapi_batch_begin(local_mem_ctx, session, &batch);
+	if (retval) goto end;
+
+	for (i = 0; i < count; i += chunk_count) {
+		chunk_count = MIN(count - i, ICAL2EXCHANGE_BULK_CHUNK);
+		chunk_ctx = talloc_named(local_mem_ctx, 0, "IcalCalendar2Exchange_chunk");
+		events = chunk_ctx ? talloc_zero_array(chunk_ctx, struct ical2exchange_bulk_event, chunk_count) : NULL;
+		if (!events) {
+			retval = MAPI_E_NOT_ENOUGH_MEMORY;
+			goto end;
+		}
+
+		/* Step 2. Convert the events of the chunk */
+		for (j = 0; j < chunk_count; j++) {
+			mapi_object_init(&events[j].obj_message);
+
+			ical2exchange_init(&ical2exchange, chunk_ctx);
+			ical2exchange.method = ICAL_METHOD_PUBLISH;
+			ical2exchange.obj_message = &events[j].obj_message;
+			ical2exchange_get_properties(&ical2exchange, vevents[i + j]);
+			ical2exchange_convert_event(&ical2exchange);
+			events[j].lpProps = ical2exchange.lpProps;
+			events[j].cValues = ical2exchange.cValues;
+			ical2exchange_reset(&ical2exchange);
+
+			if (events[j].cValues) {
+				status[i + j].retval = ical2exchange_bulk_map_named(local_mem_ctx, obj_folder, &nameid_cache,
+										    events[j].lpProps, events[j].cValues);
+			} else {
+				status[i + j].retval = MAPI_E_INVALID_PARAMETER;
+			}
+		}
+
+		/* Step 3. Write the messages, flushing whenever the batch
+		 * is full */
+		for (j = 0; j < chunk_count; j++) {
+			if (status[i + j].retval != MAPI_E_SUCCESS) continue;
+
+			for (step = 0; step < 4; step++) {
+				retval = ical2exchange_bulk_queue_step(batch, obj_folder, &events[j], step);
+				if (retval == MAPI_E_NOT_ENOUGH_RESOURCES) {
+					retval = mapi_batch_flush(batch);
+					if (retval) goto end;
+					retval = ical2exchange_bulk_queue_step(batch, obj_folder, &events[j], step);
+				}
+				if (retval) goto end;
+			}
+		}
+		retval = mapi_batch_flush(batch);
+		if (retval) goto end;
+
+		/* Step 4. Report the status of each event */
+		for (j = 0; j < chunk_count; j++) {
+			if (status[i + j].retval != MAPI_E_SUCCESS) continue;
+
+			if (events[j].create_status) {
+				status[i + j].retval = events[j].create_status;
+			} else if (events[j].set_status) {
+				status[i + j].retval = events[j].set_status;
+			} else {
+				status[i + j].retval = events[j].save_status;
+			}
+		}
+		talloc_free(chunk_ctx);
+
+		if (progress_fn) {
+			progress_fn(i + chunk_count, count, private_data);
+		}
+	}
+	retval = MAPI_E_SUCCESS;
+
+end:
+	if (countp) {
+		*countp = count;
+	}
+	if (statusp) {
+		*statusp = status;
+	} else {
+		talloc_free(status);
+	}
+	talloc_free(local_mem_ctx);
+
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	return MAPI_E_SUCCESS;
+}
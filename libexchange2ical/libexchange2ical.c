@@ -58,3 +58,11 @@ icalcomponent *Exchange2IcalEvents(mapi_object_t *obj_folder, struct GlobalObjec
 	exchange2ical_check.GlobalObjectId=GlobalObjectId;
 	return _Exchange2Ical(obj_folder, &exchange2ical_check);
 }
+
+
+icalcomponent *Exchange2IcalMessage(mapi_object_t *obj_folder, mapi_id_t mid)
+{
+	struct exchange2ical_check exchange2ical_check;
+	exchange2ical_check.eFlags=EntireFlag;
+	return _Exchange2IcalMessage(obj_folder, mid, &exchange2ical_check);
+}
@@ -91,4 +91,51 @@ icalcomponent *Exchange2IcalEvent(mapi_object_t *obj_folder, struct GlobalObject
  */
 icalcomponent *Exchange2IcalEvents(mapi_object_t *obj_folder, struct GlobalObjectId *GlobalObjectId);
 
+
+/**
+   \details Retrieve a single exchange appointment as an Icalendar
+
+   This function returns an Icalendar with the appointment stored in
+   the message mid of obj_folder, together with its exceptions.
+
+   \param obj_folder the folder to operate in
+   \param mid the message identifier of the appointment
+
+   \return Icalendar on success, otherwise Null
+
+   \note Developers should call ical_component_free() on the returned icalendar after use.
+
+ */
+icalcomponent *Exchange2IcalMessage(mapi_object_t *obj_folder, mapi_id_t mid);
+
+
+/**
+   \details Import the events of an Icalendar into an exchange calendar
+
+   This function creates a message in obj_folder for each VEVENT of
+   vcalendar. The messages are written in batches of several events,
+   and an event that cannot be imported does not stop the import.
+
+   \param mem_ctx the memory context the status array is allocated with
+   \param obj_folder the folder to operate in
+   \param vcalendar the Icalendar to import, or a single VEVENT
+   \param progress_fn function called with the number of events
+   processed and the number of events of vcalendar, may be NULL
+   \param private_data pointer passed to progress_fn
+   \param statusp pointer on pointer to the status of each event to
+   return, in the order of vcalendar, may be NULL
+   \param countp pointer to the number of events to return, may be NULL
+
+   \return MAPI_E_SUCCESS if every event was processed, otherwise MAPI
+   error.
+
+   \note Developers should check the status of each event: a
+   MAPI_E_SUCCESS return value does not mean all the events were
+   imported. Events processed before a MAPI error are reported too.
+
+ */
+enum MAPISTATUS Ical2Exchange(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder, icalcomponent *vcalendar,
+			      ical2exchange_progress_fn progress_fn, void *private_data,
+			      struct ical2exchange_status **statusp, uint32_t *countp);
+
 #endif /* __LIBEXCHANGE2ICAL_H_ */
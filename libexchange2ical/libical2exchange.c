@@ -20,3 +20,10 @@
 */
 
 #include "libexchange2ical/libexchange2ical.h"
+
+enum MAPISTATUS Ical2Exchange(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder, icalcomponent *vcalendar,
+			      ical2exchange_progress_fn progress_fn, void *private_data,
+			      struct ical2exchange_status **statusp, uint32_t *countp)
+{
+	return _IcalCalendar2Exchange(mem_ctx, obj_folder, vcalendar, progress_fn, private_data, statusp, countp);
+}
@@ -0,0 +1,277 @@
+/*
+   libmapi C++ Wrapper
+   Asynchronous Session Classes
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMAPIPP__ASYNC_H__
+#define LIBMAPIPP__ASYNC_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libmapi++/clibmapi.h>
+#include <libmapi++/mapi_exception.h>
+#include <libmapi++/session.h>
+#include <libmapi++/folder.h>
+#include <libmapi++/message.h>
+
+namespace libmapipp
+{
+
+/**
+ * \brief A pool of threads running the calls of async_session objects.
+ *
+ * A single executor can drive many sessions: each session runs one call
+ * at a time, calls of different sessions run in parallel. The sessions
+ * must be destroyed before their executor.
+ */
+class executor {
+	public:
+		/**
+		 * \brief Constructor
+		 *
+		 * \param threads The number of threads of the pool. If 0, the
+		 * number of hardware threads is used.
+		 */
+		explicit executor(unsigned int threads = 0);
+
+		executor(const executor&) = delete;
+		executor& operator=(const executor&) = delete;
+
+		/// \brief Queue a task to run on one of the threads.
+		void post(std::function<void()> task);
+
+		/// \brief Destructor. Runs the queued tasks and joins the threads.
+		~executor();
+
+	private:
+		std::mutex				m_mutex;
+		std::condition_variable			m_cond;
+		std::deque<std::function<void()> >	m_tasks;
+		std::vector<std::thread>		m_threads;
+		bool					m_stopping;
+
+		void run();
+};
+
+
+/**
+ * \brief A token to cancel calls which have not started yet.
+ *
+ * Copies share the same state, so a token can be handed to several
+ * calls and cancelled from any thread.
+ */
+class cancellation {
+	public:
+		cancellation() : m_cancelled(std::make_shared<std::atomic<bool> >(false)) {}
+
+		/// \brief Cancel the calls holding this token.
+		void cancel() { *m_cancelled = true; }
+
+		/// \brief Whether cancel() was called.
+		bool is_cancelled() const { return *m_cancelled; }
+
+	private:
+		std::shared_ptr<std::atomic<bool> >	m_cancelled;
+};
+
+
+/**
+ * \brief Options of an asynchronous call.
+ *
+ * A call cancelled or past its deadline before it starts fails with
+ * MAPI_E_USER_CANCEL or MAPI_E_TIMEOUT. Once started, the requests it
+ * sends time out at the deadline and the call fails with
+ * MAPI_E_CALL_FAILED.
+ */
+struct call_options {
+	typedef std::chrono::steady_clock	clock;
+
+	call_options() : deadline(clock::time_point::max()) {}
+
+	/// \brief Options with a deadline relative to now.
+	template <typename Rep, typename Period>
+	static call_options within(const std::chrono::duration<Rep, Period>& timeout)
+	{
+		call_options options;
+
+		options.deadline = clock::now() + std::chrono::duration_cast<clock::duration>(timeout);
+		return options;
+	}
+
+	clock::time_point	deadline;
+	cancellation		token;
+};
+
+
+/**
+ * \brief A session driven by an executor.
+ *
+ * libmapi sessions cannot be used by several threads at once. An
+ * %async_session owns a session and runs the calls submitted to it one
+ * at a time, in order, on the executor threads. The caller gets a
+ * std::future, or a callback run on the executor thread.
+ *
+ * Objects returned by the calls (folders, messages, attachments) belong
+ * to the session and must only be used from calls submitted to it.
+ */
+class async_session {
+	public:
+		/**
+		 * \brief Constructor
+		 *
+		 * \param pool The executor to run the calls on.
+		 * \param profiledb The profile database, see session::session()
+		 * \param debug Whether to output debug information to stdout
+		 * \param request_timeout The timeout of the requests of calls
+		 * without a deadline, in seconds.
+		 */
+		async_session(executor& pool, const std::string& profiledb = "", const bool debug = false,
+			      uint32_t request_timeout = 60)
+		: m_pool(pool), m_session(profiledb, debug), m_request_timeout(request_timeout), m_running(false)
+		{}
+
+		async_session(const async_session&) = delete;
+		async_session& operator=(const async_session&) = delete;
+
+		/**
+		 * \brief Submit a call to run on the session.
+		 *
+		 * \param call A callable taking a session& argument.
+		 * \param options The deadline and cancellation token of the call.
+		 *
+		 * \return A future holding the result of the call, or the
+		 * exception it threw.
+		 */
+		template <typename F>
+		std::future<typename std::result_of<F(session&)>::type> submit(F call, const call_options& options = call_options())
+		{
+			typedef typename std::result_of<F(session&)>::type result_type;
+
+			std::shared_ptr<std::promise<result_type> > promise = std::make_shared<std::promise<result_type> >();
+			std::future<result_type> future = promise->get_future();
+
+			enqueue([this, call, options, promise]() mutable {
+				try {
+					begin_call(options);
+					set_result(*promise, call, m_session);
+				} catch (...) {
+					promise->set_exception(std::current_exception());
+				}
+				end_call();
+			});
+
+			return future;
+		}
+
+		/**
+		 * \brief Submit a call and run a callback when it completes.
+		 *
+		 * \param call A callable taking a session& argument.
+		 * \param on_done A callable taking the ready std::future of the
+		 * call, run on the executor thread.
+		 * \param options The deadline and cancellation token of the call.
+		 */
+		template <typename F, typename C>
+		void submit_then(F call, C on_done, const call_options& options = call_options())
+		{
+			typedef typename std::result_of<F(session&)>::type result_type;
+
+			enqueue([this, call, on_done, options]() mutable {
+				std::promise<result_type> promise;
+
+				try {
+					begin_call(options);
+					set_result(promise, call, m_session);
+				} catch (...) {
+					promise.set_exception(std::current_exception());
+				}
+				end_call();
+				on_done(promise.get_future());
+			});
+		}
+
+		/// \brief Log in to the Exchange Server, see session::login()
+		std::future<void> login(const std::string& profile_name = "", const std::string& password = "",
+					const call_options& options = call_options())
+		{
+			return submit([profile_name, password](session& s) { s.login(profile_name, password); }, options);
+		}
+
+		/// \brief Fetch all messages in a %folder, see folder::fetch_messages()
+		std::future<folder::message_container_type> fetch_messages(mapi_id_t folder_id,
+									   const call_options& options = call_options())
+		{
+			return submit([folder_id](session& s) {
+				folder f(s.get_message_store(), folder_id);
+				return f.fetch_messages();
+			}, options);
+		}
+
+		/// \brief Fetch all attachments in a %message, see message::fetch_attachments()
+		std::future<message::attachment_container_type> fetch_attachments(std::shared_ptr<message> msg,
+										   const call_options& options = call_options())
+		{
+			return submit([msg](session&) { return msg->fetch_attachments(); }, options);
+		}
+
+		/// \brief Destructor. Waits for the submitted calls to complete.
+		~async_session();
+
+	private:
+		executor&				m_pool;
+		session					m_session;
+		uint32_t				m_request_timeout;
+
+		std::mutex				m_mutex;
+		std::condition_variable			m_idle;
+		std::deque<std::function<void()> >	m_calls;
+		bool					m_running;
+
+		void enqueue(std::function<void()> call);
+		void run_next();
+		void begin_call(const call_options& options);
+		void end_call() throw();
+
+		template <typename R, typename F>
+		static void set_result(std::promise<R>& promise, F& call, session& s)
+		{
+			promise.set_value(call(s));
+		}
+
+		template <typename F>
+		static void set_result(std::promise<void>& promise, F& call, session& s)
+		{
+			call(s);
+			promise.set_value();
+		}
+};
+
+} // namespace libmapipp
+
+#endif //!LIBMAPIPP__ASYNC_H__
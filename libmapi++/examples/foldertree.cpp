@@ -24,6 +24,20 @@
 
 #include <libmapi++/libmapi++.h>
 
+static void print_folder(const libmapipp::folder_tree& tree, size_t index, unsigned int level)
+{
+	const libmapipp::folder_tree::node& node = tree[index];
+
+	std::cout << std::string(level * 8, ' ') << "|-----> " << (const char*)node[PR_DISPLAY_NAME]
+		  << " (" << node.get<PR_CONTENT_COUNT>() << " items, "
+		  << node.get<PR_CONTENT_UNREAD>() << " unread)"
+		  << std::endl;
+
+	for (size_t i = 0; i < node.get_children().size(); ++i) {
+		print_folder(tree, node.get_children()[i], level + 1);
+	}
+}
+
 int main ()
 {
         try {
@@ -50,19 +64,13 @@ int main ()
 		// We start off by fetching the top level folder
 		mapi_id_t top_folder_id = msg_store.get_default_folder(olFolderTopInformationStore);
 		libmapipp::folder top_folder(msg_store, top_folder_id);
-		// Now get the child folders of the top level folder. These are returned as
-		// a std::vector of pointers to folders
-		libmapipp::folder::hierarchy_container_type child_folders = top_folder.fetch_hierarchy();
+		// Now get all the folders below the top level folder. The whole tree
+		// is read at once, with the properties we are interested in.
+		libmapipp::folder_tree tree = top_folder.fetch_tree({PR_DISPLAY_NAME, PR_CONTENT_COUNT, PR_CONTENT_UNREAD});
 		// Display the name, total item count and unread item count for each folder
-        	for (unsigned int i = 0; i < child_folders.size(); ++i) {
-			libmapipp::property_container child_props = child_folders[i]->get_property_container();
-			child_props << PR_DISPLAY_NAME << PR_CONTENT_COUNT << PR_CONTENT_UNREAD;
-			child_props.fetch();
-			std::cout << "|-----> " << (const char*)child_props[PR_DISPLAY_NAME]
-				  << " (" << (*(int*)child_props[PR_CONTENT_COUNT]) << " items, "
-				  << (*(int*)child_props[PR_CONTENT_UNREAD]) << " unread)"
-				  << std::endl;
-        	}
+		for (size_t i = 0; i < tree.get_roots().size(); ++i) {
+			print_folder(tree, tree.get_roots()[i], 0);
+		}
 
         }
         catch (libmapipp::mapi_exception e) // Catch any MAPI exceptions
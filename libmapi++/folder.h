@@ -29,6 +29,8 @@
 #include <libmapi++/mapi_exception.h>
 #include <libmapi++/object.h>
 #include <libmapi++/message.h>
+#include <libmapi++/message_table.h>
+#include <libmapi++/folder_tree.h>
 
 namespace libmapipp
 {
@@ -95,6 +97,29 @@ class folder : public object {
 		 */
 		message_container_type fetch_messages() throw(mapi_exception);
 
+		/**
+		 * \brief Read the messages in this %folder lazily
+		 *
+		 * Unlike fetch_messages(), no %message is opened: the returned
+		 * table yields rows holding the requested columns, read from the
+		 * contents table batch_size rows per round-trip.
+		 * \code
+		 * message_table table = inbox.messages({PR_SUBJECT_UNICODE, PR_MESSAGE_SIZE});
+		 * for (message_table::iterator it = table.begin(); it != table.end(); ++it)
+		 *	std::cout << (*it).get<PR_SUBJECT_UNICODE>() << std::endl;
+		 * \endcode
+		 *
+		 * \param columns The property tags to read for each %message.
+		 * \param batch_size The number of rows to read per round-trip.
+		 *
+		 * \return The contents table of this %folder.
+		 */
+		message_table messages(const std::vector<uint32_t>& columns = std::vector<uint32_t>(),
+				       uint32_t batch_size = 0x32) throw(mapi_exception)
+		{
+			return message_table(m_session, m_object, columns, batch_size);
+		}
+
 		/**
 		 * \brief Fetch all subfolders within this %folder
 		 *
@@ -102,6 +127,21 @@ class folder : public object {
 		 */
 		hierarchy_container_type fetch_hierarchy() throw(mapi_exception);
 
+		/**
+		 * \brief Fetch all the folders below this %folder at once
+		 *
+		 * The whole tree is read in one hierarchy table pass and no
+		 * %folder is opened.
+		 *
+		 * \param columns The property tags to read for each %folder.
+		 *
+		 * \return A snapshot of the folder tree.
+		 */
+		folder_tree fetch_tree(const std::vector<uint32_t>& columns = std::vector<uint32_t>()) throw(mapi_exception)
+		{
+			return folder_tree(m_object, m_id, columns);
+		}
+
 		/**
 		 * Destructor
 		 */
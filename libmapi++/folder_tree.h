@@ -0,0 +1,160 @@
+/*
+   libmapi C++ Wrapper
+   Folder Tree Class
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMAPIPP__FOLDER_TREE_H__
+#define LIBMAPIPP__FOLDER_TREE_H__
+
+#include <map>
+#include <vector>
+
+#include <libmapi++/clibmapi.h>
+#include <libmapi++/mapi_exception.h>
+#include <libmapi++/property_traits.h>
+
+namespace libmapipp
+{
+
+/**
+ * \brief A snapshot of all the folders below a %folder.
+ *
+ * Obtained from folder::fetch_tree(). The whole tree is read with
+ * GetFolderTree() in a single hierarchy table pass, instead of one
+ * fetch_hierarchy() per folder. No folder is opened: each node holds
+ * the columns requested, its parent id and its depth.
+ */
+class folder_tree {
+	public:
+		/// A folder of the tree
+		class node {
+			public:
+				/// \brief Get the %folder id.
+				mapi_id_t get_id() const { return m_row->lpProps[0].value.d; }
+
+				/// \brief Get the parent %folder id.
+				mapi_id_t get_parent_id() const { return m_row->lpProps[1].value.d; }
+
+				/// \brief Get the depth below the root of the tree, as returned in PR_DEPTH.
+				uint32_t get_depth() const { return m_row->lpProps[2].value.l; }
+
+				/// \brief Get the indexes of the child nodes in the tree.
+				const std::vector<size_t>& get_children() const { return m_children; }
+
+				/**
+				 * \brief Finds the column value associated with a property tag
+				 *
+				 * \return Property Value as a const void pointer, or NULL if
+				 * the column was not requested or the %folder has no such
+				 * property.
+				 */
+				const void* operator[](uint32_t property_tag) const
+				{
+					const SPropValue* p = find(property_tag);
+
+					return p ? get_SPropValue_data(const_cast<SPropValue*>(p)) : NULL;
+				}
+
+				/**
+				 * \brief Finds the typed value of a column known at compile time
+				 *
+				 * \sa property_container::get()
+				 */
+				template <uint32_t PropTag>
+				typename property_traits<PropTag>::value_type get() const
+				{
+					if (const SPropValue* p = find(PropTag))
+						return property_traits<PropTag>::value(*p);
+
+					throw mapi_exception(MAPI_E_NOT_FOUND, "folder_tree::node::get");
+				}
+
+			private:
+				friend class folder_tree;
+
+				explicit node(const SRow* row) : m_row(row) {}
+
+				const SPropValue* find(uint32_t property_tag) const
+				{
+					for (uint32_t i = 0; i < m_row->cValues; ++i) {
+						if ((uint32_t)m_row->lpProps[i].ulPropTag == property_tag)
+							return &m_row->lpProps[i];
+					}
+
+					return NULL;
+				}
+
+				const SRow*		m_row;
+				std::vector<size_t>	m_children;
+		};
+
+		typedef std::vector<node>::const_iterator	const_iterator;
+
+		/**
+		 * \brief Constructor
+		 *
+		 * \param obj_folder The root %folder of the tree.
+		 * \param root_id The id of the root %folder.
+		 * \param columns The property tags to read for each %folder,
+		 * besides PR_FID, PR_PARENT_FID and PR_DEPTH.
+		 */
+		folder_tree(mapi_object_t& obj_folder, mapi_id_t root_id, const std::vector<uint32_t>& columns) throw(mapi_exception);
+
+		/// Move Constructor
+		folder_tree(folder_tree&& other);
+
+		folder_tree(const folder_tree&) = delete;
+		folder_tree& operator=(const folder_tree&) = delete;
+
+		/// \brief Number of folders in the tree, not counting the root.
+		size_t size() const { return m_nodes.size(); }
+
+		/// \brief Get a node by index, in the order the server returned them.
+		const node& operator[](size_t index) const { return m_nodes[index]; }
+
+		/// \brief Get the indexes of the immediate children of the root.
+		const std::vector<size_t>& get_roots() const { return m_roots; }
+
+		/**
+		 * \brief Find a %folder by id.
+		 *
+		 * \return The node, or NULL if the %folder is not in the tree.
+		 */
+		const node* find(mapi_id_t folder_id) const
+		{
+			std::map<mapi_id_t, size_t>::const_iterator it = m_index.find(folder_id);
+
+			return (it != m_index.end()) ? &m_nodes[it->second] : NULL;
+		}
+
+		const_iterator begin() const { return m_nodes.begin(); }
+		const_iterator end() const { return m_nodes.end(); }
+
+		/// Destructor
+		~folder_tree() throw();
+
+	private:
+		SRowSet				m_rows;
+		std::vector<node>		m_nodes;
+		std::vector<size_t>		m_roots;
+		std::map<mapi_id_t, size_t>	m_index;
+};
+
+} // namespace libmapipp
+
+#endif //!LIBMAPIPP__FOLDER_TREE_H__
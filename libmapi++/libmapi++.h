@@ -26,9 +26,13 @@
 #include <libmapi++/message_store.h>
 #include <libmapi++/mapi_exception.h>
 #include <libmapi++/folder.h>
+#include <libmapi++/folder_tree.h>
 #include <libmapi++/message.h>
+#include <libmapi++/message_table.h>
 #include <libmapi++/attachment.h>
 #include <libmapi++/property_container.h>
+#include <libmapi++/property_traits.h>
 #include <libmapi++/profile.h>
+#include <libmapi++/async.h>
 
 #endif /* ! __LIBMAPIPP_H */
@@ -0,0 +1,220 @@
+/*
+   libmapi C++ Wrapper
+   Message Table Class
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMAPIPP__MESSAGE_TABLE_H__
+#define LIBMAPIPP__MESSAGE_TABLE_H__
+
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <libmapi++/clibmapi.h>
+#include <libmapi++/mapi_exception.h>
+#include <libmapi++/property_traits.h>
+#include <libmapi++/message.h>
+
+namespace libmapipp
+{
+class session;
+
+/**
+ * \brief A row of a folder contents table.
+ *
+ * A %message_row holds the columns requested from folder::messages()
+ * without opening the %message on the server. Call open() to get the
+ * full %message.
+ *
+ * A %message_row is only valid until its message_table iterator is
+ * incremented past the batch of rows it belongs to.
+ */
+class message_row {
+	public:
+		/// \brief Get the %message id.
+		mapi_id_t get_id() const { return m_row->lpProps[1].value.d; }
+
+		/// \brief Get the id of the folder the %message belongs to.
+		mapi_id_t get_folder_id() const { return m_row->lpProps[0].value.d; }
+
+		/**
+		 * \brief Finds the column value associated with a property tag
+		 *
+		 * \return Property Value as a const void pointer, or NULL if the
+		 * column was not requested or the %message has no such property.
+		 */
+		const void* operator[](uint32_t property_tag) const
+		{
+			const SPropValue* p = find(property_tag);
+
+			return p ? get_SPropValue_data(const_cast<SPropValue*>(p)) : NULL;
+		}
+
+		/**
+		 * \brief Finds the typed value of a column known at compile time
+		 *
+		 * \return The column value. Throws mapi_exception with
+		 * MAPI_E_NOT_FOUND if the %message has no such property.
+		 *
+		 * \sa property_container::get()
+		 */
+		template <uint32_t PropTag>
+		typename property_traits<PropTag>::value_type get() const
+		{
+			if (const SPropValue* p = find(PropTag))
+				return property_traits<PropTag>::value(*p);
+
+			throw mapi_exception(MAPI_E_NOT_FOUND, "message_row::get");
+		}
+
+		/**
+		 * \brief Finds the value of a column as a given type
+		 *
+		 * \return The column value. Throws mapi_exception with
+		 * MAPI_E_INVALID_TYPE if the property type cannot be read as T,
+		 * or MAPI_E_NOT_FOUND if the %message has no such property.
+		 */
+		template <typename T>
+		T get(uint32_t property_tag) const
+		{
+			if (!value_traits<T>::accepts(property_type(property_tag)))
+				throw mapi_exception(MAPI_E_INVALID_TYPE, "message_row::get");
+
+			if (const SPropValue* p = find(property_tag))
+				return value_traits<T>::value(*p);
+
+			throw mapi_exception(MAPI_E_NOT_FOUND, "message_row::get");
+		}
+
+		/**
+		 * \brief Open the %message this row describes.
+		 *
+		 * This is the only call that costs an OpenMessage round-trip.
+		 */
+		std::shared_ptr<message> open() const throw(mapi_exception)
+		{
+			return std::shared_ptr<message>(new message(*m_session, get_folder_id(), get_id()));
+		}
+
+	private:
+		friend class message_table;
+
+		message_row(session* mapi_session, const SRow* row) : m_session(mapi_session), m_row(row) {}
+
+		const SPropValue* find(uint32_t property_tag) const
+		{
+			for (uint32_t i = 0; i < m_row->cValues; ++i) {
+				if ((uint32_t)m_row->lpProps[i].ulPropTag == property_tag)
+					return &m_row->lpProps[i];
+			}
+
+			return NULL;
+		}
+
+		session*	m_session;
+		const SRow*	m_row;
+};
+
+
+/**
+ * \brief The contents table of a folder, read lazily.
+ *
+ * Obtained from folder::messages(). Rows are read from the server in
+ * batches as the table is iterated, and no %message is opened unless
+ * message_row::open() is called. The table can be iterated only once.
+ */
+class message_table {
+	public:
+		/// Input iterator over the rows of a message_table.
+		class iterator : public std::iterator<std::input_iterator_tag, message_row> {
+			public:
+				/// Default Constructor. Creates an end iterator.
+				iterator() : m_table(NULL) {}
+
+				message_row operator*() const { return m_table->current(); }
+
+				/// operator++
+				iterator& operator++()
+				{
+					m_table->advance();
+					return *this;
+				}
+
+				/// operator==
+				bool operator==(const iterator& rhs) const { return at_end() == rhs.at_end(); }
+
+				/// operator!=
+				bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+
+			private:
+				friend class message_table;
+
+				explicit iterator(message_table* table) : m_table(table) {}
+
+				bool at_end() const { return !m_table || m_table->at_end(); }
+
+				message_table*	m_table;
+		};
+
+		/**
+		 * \brief Constructor
+		 *
+		 * \param mapi_session The session the folder was opened with.
+		 * \param obj_folder The folder to read the contents table of.
+		 * \param columns The property tags to read for each %message,
+		 * besides PR_FID and PR_MID.
+		 * \param batch_size The number of rows to read per round-trip.
+		 */
+		message_table(session& mapi_session, mapi_object_t& obj_folder, const std::vector<uint32_t>& columns,
+			      uint32_t batch_size) throw(mapi_exception);
+
+		/// Move Constructor
+		message_table(message_table&& other);
+
+		message_table(const message_table&) = delete;
+		message_table& operator=(const message_table&) = delete;
+
+		/// \brief Number of messages in the table when it was opened.
+		uint32_t size() const { return m_count; }
+
+		/// \brief Read the first batch of rows and return an iterator to the first row.
+		iterator begin() throw(mapi_exception);
+
+		iterator end() { return iterator(); }
+
+		/// Destructor
+		~message_table() throw();
+
+	private:
+		session*	m_session;
+		mapi_object_t	m_table;
+		uint32_t	m_count;
+		uint32_t	m_batch_size;
+		SRowSet		m_rows;
+		uint32_t	m_pos;
+		bool		m_started;
+
+		message_row current() const { return message_row(m_session, &m_rows.aRow[m_pos]); }
+		bool at_end() const { return m_pos >= m_rows.cRows; }
+		void advance() throw(mapi_exception);
+		void query() throw(mapi_exception);
+};
+
+} // namespace libmapipp
+
+#endif //!LIBMAPIPP__MESSAGE_TABLE_H__
@@ -26,6 +26,7 @@
 
 #include <libmapi++/clibmapi.h>
 #include <libmapi++/mapi_exception.h>
+#include <libmapi++/property_traits.h>
 
 // This is not declared in any of libmapi's headers, but it is defined in libmapi/property.c
 extern "C" {
@@ -155,7 +156,17 @@ class property_container_iterator {
 };
 
 
-/// A container of properties to be used with classes derived from object.
+/**
+ * \brief A container of properties to be used with classes derived from object.
+ *
+ * The container owns the values it fetches: they remain valid until the
+ * next fetch() or fetch_all(), or until the container is destroyed. The
+ * property tags added with operator<< are kept, so fetch() can be called
+ * repeatedly to refresh the same properties; adding a tag after a fetch
+ * starts a new list in the same buffer.
+ *
+ * Containers can be moved but not copied.
+ */
 class property_container {
 
 	public:
@@ -164,25 +175,60 @@ class property_container {
 
 		/// Constructor
 		property_container(TALLOC_CTX* memory_ctx, mapi_object_t& mapi_object) : 
-		m_memory_ctx(memory_ctx), m_mapi_object(mapi_object), m_fetched(false), m_property_tag_array(NULL), m_cn_vals(0), m_property_values(0)
+		m_memory_ctx(memory_ctx), m_mapi_object(&mapi_object), m_fetched(false), m_tags_fetched(false),
+		m_property_tag_array(NULL), m_cn_vals(0), m_property_values(0)
 		{
 			m_property_value_array.cValues = 0;
 			m_property_value_array.lpProps = NULL;
 		}
 
+		/// Move Constructor
+		property_container(property_container&& other) :
+		m_memory_ctx(other.m_memory_ctx), m_mapi_object(other.m_mapi_object), m_fetched(other.m_fetched),
+		m_tags_fetched(other.m_tags_fetched), m_property_tag_array(other.m_property_tag_array),
+		m_cn_vals(other.m_cn_vals), m_property_values(other.m_property_values),
+		m_property_value_array(other.m_property_value_array)
+		{
+			other.reset();
+		}
+
+		/// Move Assignment
+		property_container& operator=(property_container&& other)
+		{
+			if (this != &other) {
+				release();
+				m_memory_ctx = other.m_memory_ctx;
+				m_mapi_object = other.m_mapi_object;
+				m_fetched = other.m_fetched;
+				m_tags_fetched = other.m_tags_fetched;
+				m_property_tag_array = other.m_property_tag_array;
+				m_cn_vals = other.m_cn_vals;
+				m_property_values = other.m_property_values;
+				m_property_value_array = other.m_property_value_array;
+				other.reset();
+			}
+
+			return *this;
+		}
+
+		property_container(const property_container&) = delete;
+		property_container& operator=(const property_container&) = delete;
+
 		/**
 		 * \brief Fetches properties with the tags supplied using operator<<
 		 *
+		 * Values from a previous fetch are released.
+		 *
 		 * \return The number of objects that were fetched.
 		 */
 		uint32_t fetch()
 		{
-			if (GetProps(&m_mapi_object, MAPI_UNICODE, m_property_tag_array, &m_property_values, &m_cn_vals) != MAPI_E_SUCCESS)
-				throw mapi_exception(GetLastError(), "property_container::fetch : GetProps");
+			free_values();
 
-			MAPIFreeBuffer(m_property_tag_array);
-			m_property_tag_array = NULL;
+			if (GetProps(m_mapi_object, MAPI_UNICODE, m_property_tag_array, &m_property_values, &m_cn_vals) != MAPI_E_SUCCESS)
+				throw mapi_exception(GetLastError(), "property_container::fetch : GetProps");
 
+			m_tags_fetched = true;
 			m_fetched = true;
 			return m_cn_vals;
 		}
@@ -190,21 +236,23 @@ class property_container {
 		/// \brief Fetches \b ALL properties of the object associated with this container.
 		void fetch_all()
 		{
-			if (GetPropsAll(&m_mapi_object, MAPI_UNICODE, &m_property_value_array) != MAPI_E_SUCCESS)
-				throw mapi_exception(GetLastError(), "property_container::fetch_all : GetPropsAll");
+			free_values();
 
-			// Free property_tag_array in case user used operator<< by mistake.
-			if (m_property_tag_array) {
-				MAPIFreeBuffer(m_property_tag_array);
-				m_property_tag_array = NULL;
-			}
+			if (GetPropsAll(m_mapi_object, MAPI_UNICODE, &m_property_value_array) != MAPI_E_SUCCESS)
+				throw mapi_exception(GetLastError(), "property_container::fetch_all : GetPropsAll");
 
+			m_tags_fetched = true;
 			m_fetched = true;
 		}
 
 		/// \brief Adds a Property Tag to be fetched by fetch().
 		property_container& operator<<(uint32_t property_tag)
 		{
+			if (m_tags_fetched && m_property_tag_array) {
+				m_property_tag_array->cValues = 0;
+				m_tags_fetched = false;
+			}
+
 			if (!m_property_tag_array) {
 				m_property_tag_array = set_SPropTagArray(m_memory_ctx, 1, property_tag);
 			} else {
@@ -232,6 +280,53 @@ class property_container {
 				return find_mapi_SPropValue_data(&m_property_value_array, property_tag);
 		}
 
+		/**
+		 * \brief Finds the typed value of a property tag known at compile time
+		 *
+		 * The return type is derived from the property type of the tag, so
+		 * no type switch happens at run time:
+		 * \code
+		 * const char* name = props.get<PR_DISPLAY_NAME_UNICODE>();
+		 * uint32_t count = props.get<PR_CONTENT_COUNT>();
+		 * \endcode
+		 *
+		 * \return The property value. Throws mapi_exception with
+		 * MAPI_E_NOT_FOUND if the property was not fetched.
+		 */
+		template <uint32_t PropTag>
+		typename property_traits<PropTag>::value_type get() const
+		{
+			if (const SPropValue* p = find_SPropValue(PropTag))
+				return property_traits<PropTag>::value(*p);
+			if (const mapi_SPropValue* p = find_mapi_SPropValue(PropTag))
+				return property_traits<PropTag>::value(*p);
+
+			throw mapi_exception(MAPI_E_NOT_FOUND, "property_container::get");
+		}
+
+		/**
+		 * \brief Finds the value of a property tag as a given type
+		 *
+		 * \param property_tag The Property Tag to be searched for
+		 *
+		 * \return The property value. Throws mapi_exception with
+		 * MAPI_E_INVALID_TYPE if the property type cannot be read as T, or
+		 * MAPI_E_NOT_FOUND if the property was not fetched.
+		 */
+		template <typename T>
+		T get(uint32_t property_tag) const
+		{
+			if (!value_traits<T>::accepts(property_type(property_tag)))
+				throw mapi_exception(MAPI_E_INVALID_TYPE, "property_container::get");
+
+			if (const SPropValue* p = find_SPropValue(property_tag))
+				return value_traits<T>::value(*p);
+			if (const mapi_SPropValue* p = find_mapi_SPropValue(property_tag))
+				return value_traits<T>::value(*p);
+
+			throw mapi_exception(MAPI_E_NOT_FOUND, "property_container::get");
+		}
+
 		enum MAPITAGS get_tag_at(uint32_t pos)
 		{
 			if (m_property_values)
@@ -274,14 +369,15 @@ class property_container {
 		/// Destructor
 		~property_container()
 		{
-			if (m_property_tag_array) MAPIFreeBuffer(m_property_tag_array);
+			release();
 		}
 
 	private:
 		TALLOC_CTX*		m_memory_ctx;
-		mapi_object_t&		m_mapi_object;
+		mapi_object_t*		m_mapi_object;
 
 		bool			m_fetched;
+		bool			m_tags_fetched;
 
 		SPropTagArray*		m_property_tag_array;
 
@@ -292,16 +388,69 @@ class property_container {
 		// Used when calling GetPropsAll (fetch_all)
 		mapi_SPropValue_array	m_property_value_array;
 
-		const void* find_SPropValue_value(uint32_t property_tag)
+		void free_values()
+		{
+			if (m_property_values) {
+				MAPIFreeBuffer(m_property_values);
+				m_property_values = NULL;
+				m_cn_vals = 0;
+			}
+			if (m_property_value_array.lpProps) {
+				MAPIFreeBuffer(m_property_value_array.lpProps);
+				m_property_value_array.lpProps = NULL;
+				m_property_value_array.cValues = 0;
+			}
+			m_fetched = false;
+		}
+
+		void release()
+		{
+			free_values();
+			if (m_property_tag_array) {
+				MAPIFreeBuffer(m_property_tag_array);
+				m_property_tag_array = NULL;
+			}
+		}
+
+		void reset()
 		{
-			for (uint32_t i = 0; i < m_cn_vals; ++i)
+			m_fetched = false;
+			m_tags_fetched = false;
+			m_property_tag_array = NULL;
+			m_cn_vals = 0;
+			m_property_values = NULL;
+			m_property_value_array.cValues = 0;
+			m_property_value_array.lpProps = NULL;
+		}
+
+		const SPropValue* find_SPropValue(uint32_t property_tag) const
+		{
+			for (uint32_t i = 0; m_property_values && i < m_cn_vals; ++i)
+			{
+				if ((uint32_t)m_property_values[i].ulPropTag == property_tag)
+					return &m_property_values[i];
+			}
+
+			return NULL;
+		}
+
+		const mapi_SPropValue* find_mapi_SPropValue(uint32_t property_tag) const
+		{
+			for (uint32_t i = 0; m_property_value_array.lpProps && i < m_property_value_array.cValues; ++i)
 			{
-			  if ((uint32_t)m_property_values[i].ulPropTag == property_tag)
-					return get_SPropValue_data(&m_property_values[i]);
+				if ((uint32_t)m_property_value_array.lpProps[i].ulPropTag == property_tag)
+					return &m_property_value_array.lpProps[i];
 			}
 
 			return NULL;
 		}
+
+		const void* find_SPropValue_value(uint32_t property_tag)
+		{
+			const SPropValue* p = find_SPropValue(property_tag);
+
+			return p ? get_SPropValue_data(const_cast<SPropValue*>(p)) : NULL;
+		}
 };
 
 } // namespace libmapipp
@@ -0,0 +1,179 @@
+/*
+   libmapi C++ Wrapper
+   Property Type Traits
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBMAPIPP__PROPERTY_TRAITS_H__
+#define LIBMAPIPP__PROPERTY_TRAITS_H__
+
+#include <stdint.h>
+
+#include <libmapi++/clibmapi.h>
+
+namespace libmapipp
+{
+
+/// \brief Property type (PT_*) of a property tag.
+constexpr uint16_t property_type(uint32_t property_tag)
+{
+	return property_tag & 0xFFFF;
+}
+
+/// A view on the data of a PT_BINARY property, whichever array it comes from.
+struct binary_view {
+	uint32_t	size;
+	const uint8_t*	data;
+};
+
+/**
+ * \brief Maps a property type to the C++ type of its values.
+ *
+ * Each specialization reads the value straight from the SPropValue
+ * (fetch()) or mapi_SPropValue (fetch_all()) union member. There is no
+ * specialization for the other property types, so using them with the
+ * typed accessors is a compile-time error.
+ */
+template <uint16_t PropType> struct property_type_traits;
+
+template <> struct property_type_traits<PT_I2> {
+	typedef uint16_t value_type;
+	static value_type value(const SPropValue& p) { return p.value.i; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.i; }
+};
+
+template <> struct property_type_traits<PT_LONG> {
+	typedef uint32_t value_type;
+	static value_type value(const SPropValue& p) { return p.value.l; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.l; }
+};
+
+template <> struct property_type_traits<PT_BOOLEAN> {
+	typedef bool value_type;
+	static value_type value(const SPropValue& p) { return p.value.b; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.b; }
+};
+
+template <> struct property_type_traits<PT_DOUBLE> {
+	typedef double value_type;
+	static value_type value(const SPropValue& p) { return p.value.dbl; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.dbl; }
+};
+
+template <> struct property_type_traits<PT_I8> {
+	typedef int64_t value_type;
+	static value_type value(const SPropValue& p) { return p.value.d; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.d; }
+};
+
+template <> struct property_type_traits<PT_ERROR> {
+	typedef uint32_t value_type;
+	static value_type value(const SPropValue& p) { return p.value.err; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.err; }
+};
+
+template <> struct property_type_traits<PT_SYSTIME> {
+	typedef FILETIME value_type;
+	static value_type value(const SPropValue& p) { return p.value.ft; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.ft; }
+};
+
+template <> struct property_type_traits<PT_STRING8> {
+	typedef const char* value_type;
+	static value_type value(const SPropValue& p) { return p.value.lpszA; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.lpszA; }
+};
+
+template <> struct property_type_traits<PT_UNICODE> {
+	typedef const char* value_type;
+	static value_type value(const SPropValue& p) { return p.value.lpszW; }
+	static value_type value(const mapi_SPropValue& p) { return p.value.lpszW; }
+};
+
+template <> struct property_type_traits<PT_BINARY> {
+	typedef binary_view value_type;
+	static value_type value(const SPropValue& p)
+	{
+		binary_view v = { p.value.bin.cb, p.value.bin.lpb };
+		return v;
+	}
+	static value_type value(const mapi_SPropValue& p)
+	{
+		binary_view v = { p.value.bin.cb, p.value.bin.lpb };
+		return v;
+	}
+};
+
+/**
+ * \brief Maps a property tag to the C++ type of its values.
+ *
+ * \code
+ * property_traits<PR_DISPLAY_NAME_UNICODE>::value_type name; // const char*
+ * \endcode
+ */
+template <uint32_t PropTag> struct property_traits : property_type_traits<property_type(PropTag)> {
+	static const uint32_t tag = PropTag;
+};
+
+/// Value traits of a C++ type read from a single property type.
+template <uint16_t PropType> struct single_value_traits {
+	static bool accepts(uint16_t type) { return type == PropType; }
+
+	template <typename P>
+	static typename property_type_traits<PropType>::value_type value(const P& p)
+	{
+		return property_type_traits<PropType>::value(p);
+	}
+};
+
+/**
+ * \brief Maps a C++ value type back to the property types it is read from.
+ *
+ * Used by the run-time checked property_container::get<T>(tag).
+ */
+template <typename T> struct value_traits;
+
+template <> struct value_traits<uint16_t> : single_value_traits<PT_I2> {};
+template <> struct value_traits<bool> : single_value_traits<PT_BOOLEAN> {};
+template <> struct value_traits<double> : single_value_traits<PT_DOUBLE> {};
+template <> struct value_traits<int64_t> : single_value_traits<PT_I8> {};
+template <> struct value_traits<FILETIME> : single_value_traits<PT_SYSTIME> {};
+template <> struct value_traits<binary_view> : single_value_traits<PT_BINARY> {};
+
+template <> struct value_traits<uint32_t> {
+	static bool accepts(uint16_t type) { return type == PT_LONG || type == PT_ERROR; }
+
+	template <typename P>
+	static uint32_t value(const P& p)
+	{
+		return (property_type(p.ulPropTag) == PT_LONG) ? p.value.l : p.value.err;
+	}
+};
+
+template <> struct value_traits<const char*> {
+	static bool accepts(uint16_t type) { return type == PT_STRING8 || type == PT_UNICODE; }
+
+	template <typename P>
+	static const char* value(const P& p)
+	{
+		return (property_type(p.ulPropTag) == PT_STRING8) ? (const char*)p.value.lpszA : p.value.lpszW;
+	}
+};
+
+} // namespace libmapipp
+
+#endif //!LIBMAPIPP__PROPERTY_TRAITS_H__
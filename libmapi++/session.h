@@ -72,6 +72,22 @@ class session {
 		 */
 		explicit session(const std::string& profiledb = "", const bool debug = false) throw(std::runtime_error, mapi_exception);
 
+		/**
+		 * \brief Move Constructor
+		 *
+		 * The logon and the message_store handle are transferred to the
+		 * new %session, which gets its own message_store. Folders and
+		 * messages keep a reference to the %session they were opened
+		 * with, so a %session should be moved before opening any.
+		 */
+		session(session&& other);
+
+		/// \brief Move Assignment. See the move constructor.
+		session& operator=(session&& other);
+
+		session(const session&) = delete;
+		session& operator=(const session&) = delete;
+
 		/**
 		 * \brief Log-in to the Exchange Server
 		 *
@@ -129,6 +145,8 @@ class session {
 		message_store		*m_message_store;
 		std::string		m_profile_name;
 
+		void take(session& other) throw();
+
 		void uninitialize() throw()
 		{
 			if (m_message_store) {
@@ -0,0 +1,139 @@
+/*
+   libmapi C++ Wrapper
+   Asynchronous Session Classes implementation.
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <libmapi++/async.h>
+
+namespace libmapipp {
+
+executor::executor(unsigned int threads) : m_stopping(false)
+{
+	if (!threads) threads = std::thread::hardware_concurrency();
+	if (!threads) threads = 1;
+
+	for (unsigned int i = 0; i < threads; ++i) {
+		m_threads.push_back(std::thread(&executor::run, this));
+	}
+}
+
+void executor::post(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_tasks.push_back(std::move(task));
+	}
+	m_cond.notify_one();
+}
+
+void executor::run()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (!m_stopping && m_tasks.empty())
+				m_cond.wait(lock);
+			if (m_tasks.empty())
+				return;
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+executor::~executor()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_cond.notify_all();
+
+	for (std::vector<std::thread>::iterator it = m_threads.begin(); it != m_threads.end(); ++it) {
+		it->join();
+	}
+}
+
+void async_session::enqueue(std::function<void()> call)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_calls.push_back(std::move(call));
+	if (!m_running) {
+		m_running = true;
+		m_pool.post(std::bind(&async_session::run_next, this));
+	}
+}
+
+void async_session::run_next()
+{
+	std::function<void()> call;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		call = std::move(m_calls.front());
+		m_calls.pop_front();
+	}
+
+	call();
+
+	// Run one call per task, so the sessions sharing the pool take turns
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_calls.empty()) {
+		m_running = false;
+		m_idle.notify_all();
+	} else {
+		m_pool.post(std::bind(&async_session::run_next, this));
+	}
+}
+
+void async_session::begin_call(const call_options& options)
+{
+	if (options.token.is_cancelled())
+		throw mapi_exception(MAPI_E_USER_CANCEL, "async_session::begin_call");
+
+	if (options.deadline == call_options::clock::time_point::max())
+		return;
+
+	call_options::clock::time_point now = call_options::clock::now();
+	if (now >= options.deadline)
+		throw mapi_exception(MAPI_E_TIMEOUT, "async_session::begin_call");
+
+	// Bound the requests of this call by the time left, rounded up
+	if (m_session.get_mapi_session()) {
+		std::chrono::seconds left = std::chrono::duration_cast<std::chrono::seconds>(options.deadline - now);
+		SetMAPIRequestTimeout(m_session.get_mapi_session(), left.count() + 1);
+	}
+}
+
+void async_session::end_call() throw()
+{
+	if (m_session.get_mapi_session())
+		SetMAPIRequestTimeout(m_session.get_mapi_session(), m_request_timeout);
+}
+
+async_session::~async_session()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_running)
+		m_idle.wait(lock);
+}
+
+} // namespace libmapipp
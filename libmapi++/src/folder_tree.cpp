@@ -0,0 +1,67 @@
+/*
+   libmapi C++ Wrapper
+   Folder Tree Class implementation.
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <libmapi++/folder_tree.h>
+
+namespace libmapipp {
+
+folder_tree::folder_tree(mapi_object_t& obj_folder, mapi_id_t root_id, const std::vector<uint32_t>& columns) throw(mapi_exception)
+{
+	SPropTagArray property_tag_array;
+
+	property_tag_array.cValues = columns.size();
+	property_tag_array.aulPropTag = (enum MAPITAGS*) (columns.empty() ? NULL : &columns[0]);
+
+	m_rows.cRows = 0;
+	m_rows.aRow = NULL;
+	if (GetFolderTree(&obj_folder, columns.empty() ? NULL : &property_tag_array, &m_rows) != MAPI_E_SUCCESS)
+		throw mapi_exception(GetLastError(), "folder_tree::folder_tree : GetFolderTree");
+
+	m_nodes.reserve(m_rows.cRows);
+	for (uint32_t i = 0; i < m_rows.cRows; ++i) {
+		m_nodes.push_back(node(&m_rows.aRow[i]));
+		m_index[m_nodes.back().get_id()] = i;
+	}
+
+	// Rows are not ordered parent first, so link them once all are indexed
+	for (size_t i = 0; i < m_nodes.size(); ++i) {
+		mapi_id_t parent_id = m_nodes[i].get_parent_id();
+		std::map<mapi_id_t, size_t>::iterator parent = m_index.find(parent_id);
+
+		if (parent_id == root_id || parent == m_index.end())
+			m_roots.push_back(i);
+		else
+			m_nodes[parent->second].m_children.push_back(i);
+	}
+}
+
+folder_tree::folder_tree(folder_tree&& other)
+: m_rows(other.m_rows), m_nodes(std::move(other.m_nodes)), m_roots(std::move(other.m_roots)), m_index(std::move(other.m_index))
+{
+	other.m_rows.cRows = 0;
+	other.m_rows.aRow = NULL;
+}
+
+folder_tree::~folder_tree() throw()
+{
+	if (m_rows.aRow) MAPIFreeBuffer(m_rows.aRow);
+}
+
+} // namespace libmapipp
@@ -0,0 +1,105 @@
+/*
+   libmapi C++ Wrapper
+   Message Table Class implementation.
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <libmapi++/message_table.h>
+#include <libmapi++/session.h>
+
+namespace libmapipp {
+
+message_table::message_table(session& mapi_session, mapi_object_t& obj_folder, const std::vector<uint32_t>& columns,
+			     uint32_t batch_size) throw(mapi_exception)
+: m_session(&mapi_session), m_count(0), m_batch_size(batch_size), m_pos(0), m_started(false)
+{
+	m_rows.cRows = 0;
+	m_rows.aRow = NULL;
+
+	mapi_object_init(&m_table);
+	if (GetContentsTable(&obj_folder, &m_table, 0, &m_count) != MAPI_E_SUCCESS) {
+		mapi_object_release(&m_table);
+		throw mapi_exception(GetLastError(), "message_table::message_table : GetContentsTable");
+	}
+
+	SPropTagArray* property_tag_array = set_SPropTagArray(mapi_session.get_memory_ctx(), 0x2, PR_FID, PR_MID);
+	for (std::vector<uint32_t>::const_iterator it = columns.begin(); it != columns.end(); ++it) {
+		SPropTagArray_add(mapi_session.get_memory_ctx(), property_tag_array, (enum MAPITAGS)*it);
+	}
+
+	if (SetColumns(&m_table, property_tag_array) != MAPI_E_SUCCESS) {
+		MAPIFreeBuffer(property_tag_array);
+		mapi_object_release(&m_table);
+		throw mapi_exception(GetLastError(), "message_table::message_table : SetColumns");
+	}
+
+	MAPIFreeBuffer(property_tag_array);
+}
+
+message_table::message_table(message_table&& other)
+: m_session(other.m_session), m_table(other.m_table), m_count(other.m_count), m_batch_size(other.m_batch_size),
+  m_rows(other.m_rows), m_pos(other.m_pos), m_started(other.m_started)
+{
+	mapi_object_init(&other.m_table);
+	other.m_rows.cRows = 0;
+	other.m_rows.aRow = NULL;
+	other.m_pos = 0;
+	other.m_started = true;
+}
+
+message_table::iterator message_table::begin() throw(mapi_exception)
+{
+	if (!m_started) {
+		m_started = true;
+		query();
+	}
+
+	return iterator(this);
+}
+
+void message_table::advance() throw(mapi_exception)
+{
+	if (++m_pos < m_rows.cRows)
+		return;
+
+	// Rows are returned by QueryRows one batch at a time
+	query();
+}
+
+void message_table::query() throw(mapi_exception)
+{
+	if (m_rows.aRow) {
+		MAPIFreeBuffer(m_rows.aRow);
+		m_rows.aRow = NULL;
+	}
+	m_rows.cRows = 0;
+	m_pos = 0;
+
+	if (QueryRows(&m_table, m_batch_size, TBL_ADVANCE, TBL_FORWARD_READ, &m_rows) != MAPI_E_SUCCESS) {
+		m_rows.cRows = 0;
+		m_rows.aRow = NULL;
+		throw mapi_exception(GetLastError(), "message_table::query : QueryRows");
+	}
+}
+
+message_table::~message_table() throw()
+{
+	if (m_rows.aRow) MAPIFreeBuffer(m_rows.aRow);
+	mapi_object_release(&m_table);
+}
+
+} // namespace libmapipp
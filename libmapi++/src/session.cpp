@@ -55,6 +55,44 @@ session::session(const std::string& profiledb, bool debug) throw(std::runtime_er
 	}
 }
 
+session::session(session&& other)
+: m_session(NULL), m_mapi_context(0), m_memory_ctx(0), m_message_store(new message_store(*this))
+{
+	take(other);
+}
+
+session& session::operator=(session&& other)
+{
+	if (this != &other) {
+		message_store* store = new message_store(*this);
+
+		uninitialize();
+		m_message_store = store;
+		take(other);
+	}
+
+	return *this;
+}
+
+void session::take(session& other) throw()
+{
+	m_session = other.m_session;
+	m_mapi_context = other.m_mapi_context;
+	m_memory_ctx = other.m_memory_ctx;
+	m_profile_name.swap(other.m_profile_name);
+
+	// The message_store handle is a plain struct, it does not depend on
+	// the address of the session object.
+	if (other.m_message_store) {
+		m_message_store->m_object = other.m_message_store->m_object;
+		mapi_object_init(&other.m_message_store->m_object);
+	}
+
+	other.m_session = NULL;
+	other.m_mapi_context = 0;
+	other.m_memory_ctx = 0;
+}
+
 void session::login(const std::string& profile_name, const std::string& password) throw (mapi_exception)
 {
 	m_profile_name = profile_name;
@@ -842,7 +842,8 @@ _PUBLIC_ enum MAPISTATUS FXGetBuffer(mapi_object_t *obj_source_context, uint16_t
 	*transferStatus = reply->TransferStatus;
 	*progressStepCount = reply->InProgressCount;
 	*totalStepCount = reply->TotalStepCount;
-	blob->length = reply->TransferBufferSize;
+	/* Chained responses may hold more than TransferBufferSize bytes */
+	blob->length = reply->TransferBuffer.length;
 	blob->data = (uint8_t *)talloc_size((TALLOC_CTX *)session, blob->length);
 	memcpy(blob->data, reply->TransferBuffer.data, blob->length);
 
@@ -119,6 +119,93 @@ _PUBLIC_ enum MAPISTATUS CreateMessage(mapi_object_t *obj_folder, mapi_object_t
 }
 
 
+struct CreateMessage_batch {
+	mapi_object_t			*obj_message;
+	uint8_t				logon_id;
+};
+
+static enum MAPISTATUS CreateMessage_batch_reply(struct mapi_batch *batch,
+						 struct EcDoRpc_MAPI_REPL *mapi_repl,
+						 uint32_t handle, void *private_data)
+{
+	struct CreateMessage_batch	*ctx = (struct CreateMessage_batch *) private_data;
+
+	mapi_object_set_session(ctx->obj_message, mapi_batch_get_session(batch));
+	mapi_object_set_handle(ctx->obj_message, handle);
+	mapi_object_set_logon_id(ctx->obj_message, ctx->logon_id);
+	if (mapi_repl->u.mapi_CreateMessage.HasMessageId) {
+		mapi_object_set_id(ctx->obj_message, mapi_repl->u.mapi_CreateMessage.MessageId.MessageId);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the creation of a message in a batch
+
+   The message is created when the batch is flushed, it can be used as
+   input by the calls queued after this one in the same batch.
+
+   \param batch pointer to the batch
+   \param obj_folder the folder to create the message in
+   \param obj_message the resulting message object
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
+
+   \return MAPI_E_SUCCESS if the call was queued, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: obj_folder does not belong to the batch
+     session
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the batch is full and must be
+     flushed first
+
+   \sa mapi_batch_begin, mapi_batch_flush, CreateMessage
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_CreateMessage(struct mapi_batch *batch,
+						  mapi_object_t *obj_folder,
+						  mapi_object_t *obj_message,
+						  enum MAPISTATUS *status)
+{
+	struct EcDoRpc_MAPI_REQ		*mapi_req;
+	struct CreateMessage_batch	*ctx;
+	enum MAPISTATUS			retval;
+	uint8_t				logon_id;
+	uint8_t				output_idx;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch || !obj_folder || !obj_message, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(mapi_object_get_session(obj_folder) != mapi_batch_get_session(batch),
+			     MAPI_E_INVALID_PARAMETER, NULL);
+
+	if ((retval = mapi_object_get_logon_id(obj_folder, &logon_id)) != MAPI_E_SUCCESS)
+		return retval;
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(NULL, struct EcDoRpc_MAPI_REQ);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	mapi_req->opnum = op_MAPI_CreateMessage;
+	mapi_req->logon_id = logon_id;
+	mapi_req->u.mapi_CreateMessage.CodePageId = 0xfff;
+	mapi_req->u.mapi_CreateMessage.FolderId = mapi_object_get_id(obj_folder);
+	mapi_req->u.mapi_CreateMessage.AssociatedFlag = 0;
+
+	ctx = talloc_zero(mapi_req, struct CreateMessage_batch);
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	ctx->obj_message = obj_message;
+	ctx->logon_id = logon_id;
+
+	retval = mapi_batch_queue(batch, obj_folder, obj_message, mapi_req, CreateMessage_batch_reply,
+				  ctx, status, &output_idx);
+	OPENCHANGE_RETVAL_IF(retval, retval, mapi_req);
+	mapi_req->u.mapi_CreateMessage.handle_idx = output_idx;
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Delete one or more messages
 
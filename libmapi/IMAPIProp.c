@@ -174,6 +174,119 @@ _PUBLIC_ enum MAPISTATUS GetProps(mapi_object_t *obj,
 }
 
 
+struct GetProps_batch {
+	struct mapi_session		*session;
+	struct SPropTagArray		properties;
+	struct SPropValue		**lpProps;
+	uint32_t			*PropCount;
+};
+
+static enum MAPISTATUS GetProps_batch_reply(struct mapi_batch *batch,
+					    struct EcDoRpc_MAPI_REPL *mapi_repl,
+					    uint32_t handle, void *private_data)
+{
+	struct GetProps_batch	*ctx = (struct GetProps_batch *) private_data;
+	enum MAPISTATUS		mapistatus;
+
+	mapistatus = emsmdb_get_SPropValue((TALLOC_CTX *)ctx->session,
+					   &mapi_repl->u.mapi_GetProps.prop_data,
+					   &ctx->properties, ctx->lpProps, ctx->PropCount,
+					   mapi_repl->u.mapi_GetProps.layout);
+	if (!mapistatus && (mapi_repl->error_code == MAPI_W_ERRORS_RETURNED)) {
+		return MAPI_W_ERRORS_RETURNED;
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the retrieval of properties in a batch
+
+   The properties are retrieved when the batch is flushed and obj may
+   be an object opened by a call queued earlier in the same batch.
+   Named properties are not resolved: SPropTagArray must only hold
+   property tags already known to the server, as with the
+   MAPI_PROPS_SKIP_NAMEDID_CHECK flag of GetProps.
+
+   \param batch pointer to the batch
+   \param obj the object to get properties on
+   \param flags Flags for behaviour; can be MAPI_UNICODE
+   \param SPropTagArray an array of MAPI property tags
+   \param lpProps pointer to the resulting SPropValue array, set when
+   the batch is flushed
+   \param PropCount pointer to the number of properties in lpProps,
+   set when the batch is flushed
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
+
+   \return MAPI_E_SUCCESS if the call was queued, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: a parameter is missing or obj does not
+     belong to the batch session
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the batch is full and must be
+     flushed first
+
+   \sa mapi_batch_begin, mapi_batch_flush, GetProps
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_GetProps(struct mapi_batch *batch,
+					     mapi_object_t *obj,
+					     uint32_t flags,
+					     struct SPropTagArray *SPropTagArray,
+					     struct SPropValue **lpProps,
+					     uint32_t *PropCount,
+					     enum MAPISTATUS *status)
+{
+	struct EcDoRpc_MAPI_REQ	*mapi_req;
+	struct GetProps_batch	*ctx;
+	struct mapi_session	*session;
+	enum MAPISTATUS		retval;
+	uint8_t			logon_id;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch || !obj, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!SPropTagArray || !lpProps || !PropCount, MAPI_E_INVALID_PARAMETER, NULL);
+
+	session = mapi_batch_get_session(batch);
+
+	/* An object opened in the batch has no session until then */
+	if (mapi_batch_get_logon_id(batch, obj, &logon_id) != MAPI_E_SUCCESS) {
+		OPENCHANGE_RETVAL_IF(mapi_object_get_session(obj) != session, MAPI_E_INVALID_PARAMETER, NULL);
+		if ((retval = mapi_object_get_logon_id(obj, &logon_id)) != MAPI_E_SUCCESS)
+			return retval;
+	}
+
+	*PropCount = 0;
+	*lpProps = NULL;
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(NULL, struct EcDoRpc_MAPI_REQ);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	mapi_req->opnum = op_MAPI_GetProps;
+	mapi_req->logon_id = logon_id;
+	mapi_req->u.mapi_GetProps.PropertySizeLimit = 0x0;
+	mapi_req->u.mapi_GetProps.WantUnicode = (flags & MAPI_UNICODE) != 0 ? true : 0x0;
+	mapi_req->u.mapi_GetProps.prop_count = (uint16_t) SPropTagArray->cValues;
+
+	ctx = talloc_zero(mapi_req, struct GetProps_batch);
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	ctx->session = session;
+	ctx->properties.cValues = SPropTagArray->cValues;
+	ctx->properties.aulPropTag = talloc_memdup(ctx, SPropTagArray->aulPropTag, SPropTagArray->cValues * sizeof(enum MAPITAGS));
+	OPENCHANGE_RETVAL_IF(!ctx->properties.aulPropTag, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	ctx->lpProps = lpProps;
+	ctx->PropCount = PropCount;
+	mapi_req->u.mapi_GetProps.properties = ctx->properties.aulPropTag;
+
+	retval = mapi_batch_queue(batch, obj, NULL, mapi_req, GetProps_batch_reply, ctx, status, NULL);
+	OPENCHANGE_RETVAL_IF(retval, retval, mapi_req);
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Set one or more properties on a given object
 
@@ -292,6 +405,85 @@ _PUBLIC_ enum MAPISTATUS SetProps(mapi_object_t *obj,
 }
 
 
+static enum MAPISTATUS SetProps_batch_reply(struct mapi_batch *batch,
+					    struct EcDoRpc_MAPI_REPL *mapi_repl,
+					    uint32_t handle, void *private_data)
+{
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the setting of properties in a batch
+
+   The properties are set when the batch is flushed and obj may be an
+   object opened by a call queued earlier in the same batch. The
+   values are copied when the call is queued. Named properties are not
+   resolved: lpProps must only hold property tags already known to the
+   server, as with the MAPI_PROPS_SKIP_NAMEDID_CHECK flag of SetProps.
+
+   \param batch pointer to the batch
+   \param obj the object to set properties on
+   \param lpProps the list of properties to set
+   \param PropCount the number of properties
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
+
+   \return MAPI_E_SUCCESS if the call was queued, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: a parameter is missing or obj does not
+     belong to the batch session
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the batch is full and must be
+     flushed first
+
+   \sa mapi_batch_begin, mapi_batch_flush, SetProps
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_SetProps(struct mapi_batch *batch,
+					     mapi_object_t *obj,
+					     struct SPropValue *lpProps,
+					     unsigned long PropCount,
+					     enum MAPISTATUS *status)
+{
+	struct EcDoRpc_MAPI_REQ	*mapi_req;
+	struct mapi_session	*session;
+	enum MAPISTATUS		retval;
+	unsigned long		i;
+	uint8_t			logon_id;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch || !obj || !lpProps, MAPI_E_INVALID_PARAMETER, NULL);
+
+	session = mapi_batch_get_session(batch);
+
+	/* An object opened in the batch has no session until then */
+	if (mapi_batch_get_logon_id(batch, obj, &logon_id) != MAPI_E_SUCCESS) {
+		OPENCHANGE_RETVAL_IF(mapi_object_get_session(obj) != session, MAPI_E_INVALID_PARAMETER, NULL);
+		if ((retval = mapi_object_get_logon_id(obj, &logon_id)) != MAPI_E_SUCCESS)
+			return retval;
+	}
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(NULL, struct EcDoRpc_MAPI_REQ);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	mapi_req->opnum = op_MAPI_SetProps;
+	mapi_req->logon_id = logon_id;
+	mapi_req->u.mapi_SetProps.values.cValues = PropCount;
+	mapi_req->u.mapi_SetProps.values.lpProps = talloc_array(mapi_req, struct mapi_SPropValue, PropCount);
+	OPENCHANGE_RETVAL_IF(!mapi_req->u.mapi_SetProps.values.lpProps, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	for (i = 0; i < PropCount; i++) {
+		cast_mapi_SPropValue((TALLOC_CTX *)mapi_req->u.mapi_SetProps.values.lpProps,
+				     &mapi_req->u.mapi_SetProps.values.lpProps[i], &lpProps[i]);
+	}
+
+	retval = mapi_batch_queue(batch, obj, NULL, mapi_req, SetProps_batch_reply, NULL, status, NULL);
+	OPENCHANGE_RETVAL_IF(retval, retval, mapi_req);
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Makes permanent any changes made to an attachment since the
    last save operation.
@@ -962,6 +1154,10 @@ _PUBLIC_ enum MAPISTATUS GetNamesFromIDs(mapi_object_t *obj,
    \note count and nameid parameter can automatically be built
    using the mapi_nameid API.
 
+   \note Mappings resolved by the server are cached in the session
+   for the lifetime of the logon: names already resolved are not sent
+   again and no RPC is issued when all of them are cached.
+
    \return MAPI_E_SUCCESS on success, otherwise MAPI error.
 
    \note Developers may also call GetLastError() to retrieve the last
@@ -990,7 +1186,10 @@ _PUBLIC_ enum MAPISTATUS GetIDsFromNames(mapi_object_t *obj,
 	uint32_t			size = 0;
 	TALLOC_CTX			*mem_ctx;
 	uint32_t			i;
+	uint32_t			j;
 	uint8_t				logon_id;
+	uint16_t			*propID;
+	uint16_t			*missing;
 
 	/* sanity checks */
 	OPENCHANGE_RETVAL_IF(!obj, MAPI_E_INVALID_PARAMETER, NULL);
@@ -1009,13 +1208,33 @@ _PUBLIC_ enum MAPISTATUS GetIDsFromNames(mapi_object_t *obj,
 	mem_ctx = talloc_named(session, 0, "GetIDsFromNames");
 	size = 0;
 
+	/* Only ask the server for names this logon has not resolved yet */
+	propID = talloc_zero_array(mem_ctx, uint16_t, count);
+	missing = talloc_array(mem_ctx, uint16_t, count);
+	OPENCHANGE_RETVAL_IF(!propID || !missing, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	request.count = 0;
+	for (i = 0; i < count; i++) {
+		if (!mapi_nameid_cache_lookup(session, logon_id, &nameid[i], &propID[i])) {
+			missing[request.count++] = i;
+		}
+	}
+	retval = MAPI_E_SUCCESS;
+	if (!request.count) goto fill;
+
 	/* Fill the GetIDsFromNames operation */
 	request.ulFlags = ulFlags;
-	request.count = count;
 	size += sizeof (uint8_t) + sizeof (uint16_t);
 
-	request.nameid = nameid;
-	for (i = 0; i < count; i++) {
+	if (request.count == count) {
+		request.nameid = nameid;
+	} else {
+		request.nameid = talloc_array(mem_ctx, struct MAPINAMEID, request.count);
+		OPENCHANGE_RETVAL_IF(!request.nameid, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+		for (i = 0; i < request.count; i++) {
+			request.nameid[i] = nameid[missing[i]];
+		}
+	}
+	for (i = 0; i < request.count; i++) {
 		size += sizeof (uint8_t) + sizeof (request.nameid[i].lpguid);
 		switch (request.nameid[i].ulKind) {
 		case MNID_ID:
@@ -1053,18 +1272,26 @@ _PUBLIC_ enum MAPISTATUS GetIDsFromNames(mapi_object_t *obj,
 	OPENCHANGE_RETVAL_IF((retval != MAPI_W_ERRORS_RETURNED) && (retval != MAPI_E_SUCCESS), retval, mem_ctx);
 	OPENCHANGE_CHECK_NOTIFICATION(session, mapi_response);
 
+	/* Merge server results with cached ones and remember them */
+	for (i = 0; i < request.count && i < mapi_response->mapi_repl->u.mapi_GetIDsFromNames.count; i++) {
+		j = missing[i];
+		propID[j] = mapi_response->mapi_repl->u.mapi_GetIDsFromNames.propID[i];
+		mapi_nameid_cache_add(session, logon_id, &nameid[j], propID[j]);
+	}
+	talloc_free(mapi_response);
+
+fill:
 	/* Fill the SPropTagArray */
-	proptags[0]->cValues = mapi_response->mapi_repl->u.mapi_GetIDsFromNames.count;
+	proptags[0]->cValues = count;
 	proptags[0]->aulPropTag = (enum MAPITAGS *) talloc_array((TALLOC_CTX *)proptags[0], uint32_t, proptags[0]->cValues);
 	for (i = 0; i < proptags[0]->cValues; i++) {
-		if (mapi_response->mapi_repl->u.mapi_GetIDsFromNames.propID[i]) {
-			proptags[0]->aulPropTag[i] = (enum MAPITAGS)(((int)mapi_response->mapi_repl->u.mapi_GetIDsFromNames.propID[i] << 16) | PT_UNSPECIFIED);
+		if (propID[i]) {
+			proptags[0]->aulPropTag[i] = (enum MAPITAGS)(((int)propID[i] << 16) | PT_UNSPECIFIED);
 		} else {
 			proptags[0]->aulPropTag[i] = PT_ERROR;
 		}
 	}
 
-	talloc_free(mapi_response);
 	talloc_free(mem_ctx);
 
 	return retval;
@@ -20,6 +20,8 @@
 #include "libmapi/libmapi.h"
 #include "libmapi/libmapi_private.h"
 
+#include <tevent.h>
+
 
 /**
    \file IMAPISupport.c
@@ -442,3 +444,278 @@ _PUBLIC_ enum MAPISTATUS MonitorNotification(struct mapi_session *session, void
 
 	return MAPI_E_SUCCESS;
 }
+
+
+/* Delay before dispatching again while the session is busy, in microseconds */
+#define	MAPI_ASYNC_NOTIFY_BUSY_DELAY	10000
+
+struct mapi_async_notify {
+	struct mapi_session		*session;
+	struct tevent_context		*ev;
+	struct tevent_req		*req;
+	mapi_async_notify_callback_t	callback;
+	void				*private_data;
+	bool				in_callback;
+	bool				cancelled;
+};
+
+static void mapi_async_notify_done(struct tevent_req *);
+
+static int mapi_async_notify_destructor(struct mapi_async_notify *async_notify)
+{
+	if (async_notify->session->async_notify == async_notify) {
+		async_notify->session->async_notify = NULL;
+	}
+	return 0;
+}
+
+/* Report an error or dispatched notifications, true when the monitoring stops */
+static bool mapi_async_notify_report(struct mapi_async_notify *async_notify, enum MAPISTATUS retval)
+{
+	bool	stop;
+
+	stop = (retval != MAPI_E_SUCCESS);
+	if (async_notify->callback) {
+		async_notify->in_callback = true;
+		if (async_notify->callback(async_notify->session, retval, async_notify->private_data)) {
+			stop = true;
+		}
+		async_notify->in_callback = false;
+	}
+	if (async_notify->cancelled) {
+		stop = true;
+	}
+	if (stop) {
+		talloc_free(async_notify);
+	}
+
+	return stop;
+}
+
+static void mapi_async_notify_arm(struct mapi_async_notify *async_notify)
+{
+	struct emsmdb_context	*emsmdb;
+
+	emsmdb = (struct emsmdb_context *)async_notify->session->emsmdb->ctx;
+	async_notify->req = emsmdb_async_waitex_send(async_notify, async_notify->ev, emsmdb, 0);
+	if (!async_notify->req) {
+		mapi_async_notify_report(async_notify, MAPI_E_NOT_ENOUGH_RESOURCES);
+		return;
+	}
+	tevent_req_set_callback(async_notify->req, mapi_async_notify_done, async_notify);
+}
+
+static void mapi_async_notify_dispatch(struct tevent_context *ev, struct tevent_timer *te,
+				       struct timeval current_time, void *private_data)
+{
+	struct mapi_async_notify	*async_notify = (struct mapi_async_notify *)private_data;
+	enum MAPISTATUS			retval;
+
+	/* A blocking call of the session runs the loop: fetch the
+	 * notifications once it is done */
+	if (async_notify->session->busy) {
+		if (!tevent_add_timer(ev, async_notify, tevent_timeval_current_ofs(0, MAPI_ASYNC_NOTIFY_BUSY_DELAY),
+				      mapi_async_notify_dispatch, async_notify)) {
+			mapi_async_notify_report(async_notify, MAPI_E_NOT_ENOUGH_RESOURCES);
+		}
+		return;
+	}
+
+	retval = DispatchNotifications(async_notify->session);
+	if (mapi_async_notify_report(async_notify, retval)) return;
+
+	mapi_async_notify_arm(async_notify);
+}
+
+static void mapi_async_notify_done(struct tevent_req *req)
+{
+	struct mapi_async_notify	*async_notify = tevent_req_callback_data(req, struct mapi_async_notify);
+	enum MAPISTATUS			retval;
+	uint32_t			flags = 0;
+
+	retval = emsmdb_async_waitex_recv(req, &flags);
+	talloc_free(req);
+	async_notify->req = NULL;
+
+	/* The server completes the call without changes every 5 minutes */
+	if (retval == MAPI_E_TIMEOUT || (retval == MAPI_E_SUCCESS && !flags)) {
+		mapi_async_notify_arm(async_notify);
+		return;
+	}
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_async_notify_report(async_notify, retval);
+		return;
+	}
+
+	mapi_async_notify_dispatch(async_notify->ev, NULL, tevent_timeval_current(), async_notify);
+}
+
+
+/**
+   \details Monitor the notifications of a session without blocking
+
+   An asynchronous wait call is parked for the session on the event
+   context set with SetMAPIEventContext(). When the server signals
+   changes, the pending notifications are fetched and dispatched to
+   the callbacks registered with Subscribe(), then callback is called.
+   The wait call is parked again until callback returns non-zero, an
+   error occurs or CancelAsyncNotification() is called.
+
+   Any number of sessions can be monitored this way by a single
+   thread, running LoopAsyncNotifications() or its own loop on the
+   event context.
+
+   \param session the session to monitor, logged on after
+   SetMAPIEventContext()
+   \param callback the function called after each dispatch or on
+   error, may be NULL
+   \param private_data private data passed to callback
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: session is NULL or its connection is
+     not driven by the event context of the MAPI context
+   - MAPI_E_NOT_INITIALIZED: no event context is set, or the server
+     doesn't support asynchronous notifications
+   - MAPI_E_NOT_ENOUGH_RESOURCES: no memory left
+
+   \sa SetMAPIEventContext, CancelAsyncNotification, LoopAsyncNotifications
+*/
+_PUBLIC_ enum MAPISTATUS MonitorAsyncNotification(struct mapi_session *session,
+						  mapi_async_notify_callback_t callback,
+						  void *private_data)
+{
+	struct emsmdb_context		*emsmdb;
+	struct mapi_async_notify	*async_notify;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!session->mapi_ctx || !session->mapi_ctx->ev, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!session->emsmdb || !session->emsmdb->ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!session->notify_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	emsmdb = (struct emsmdb_context *)session->emsmdb->ctx;
+	OPENCHANGE_RETVAL_IF(!emsmdb->async_rpc_connection, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(dcerpc_event_context(emsmdb->async_rpc_connection) != session->mapi_ctx->ev,
+			     MAPI_E_INVALID_PARAMETER, NULL);
+
+	/* Already monitored: only update the callback */
+	if (session->async_notify) {
+		session->async_notify->callback = callback;
+		session->async_notify->private_data = private_data;
+		return MAPI_E_SUCCESS;
+	}
+
+	async_notify = talloc_zero(session, struct mapi_async_notify);
+	OPENCHANGE_RETVAL_IF(!async_notify, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+	async_notify->session = session;
+	async_notify->ev = session->mapi_ctx->ev;
+	async_notify->callback = callback;
+	async_notify->private_data = private_data;
+
+	async_notify->req = emsmdb_async_waitex_send(async_notify, async_notify->ev, emsmdb, 0);
+	OPENCHANGE_RETVAL_IF(!async_notify->req, MAPI_E_NOT_ENOUGH_RESOURCES, async_notify);
+	tevent_req_set_callback(async_notify->req, mapi_async_notify_done, async_notify);
+
+	session->async_notify = async_notify;
+	talloc_set_destructor(async_notify, mapi_async_notify_destructor);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Stop monitoring the notifications of a session
+
+   The parked wait call is abandoned. This can be called from the
+   callback given to MonitorAsyncNotification().
+
+   \param session the session monitored
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: session is NULL
+   - MAPI_E_NOT_FOUND: the session is not monitored
+
+   \sa MonitorAsyncNotification
+*/
+_PUBLIC_ enum MAPISTATUS CancelAsyncNotification(struct mapi_session *session)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!session->async_notify, MAPI_E_NOT_FOUND, NULL);
+
+	if (session->async_notify->in_callback) {
+		session->async_notify->cancelled = true;
+	} else {
+		talloc_free(session->async_notify);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static void mapi_async_notify_loop_timeout(struct tevent_context *ev, struct tevent_timer *te,
+					   struct timeval current_time, void *private_data)
+{
+}
+
+/**
+   \details Process the notifications of the monitored sessions
+
+   This function runs the event context of the MAPI context for as
+   long as sessions are monitored with MonitorAsyncNotification().
+
+   The function takes a callback in cb_data to check if it should
+   continue to process notifications. Timeval in cb_data bounds the
+   time waited for an event before the callback is consulted.
+
+   \param mapi_ctx pointer to the MAPI context
+   \param cb_data the continue callback, may be NULL
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_NOT_INITIALIZED: no event context is set
+   - MAPI_E_CALL_FAILED: the event context failed
+
+   \sa MonitorAsyncNotification, SetMAPIEventContext
+*/
+_PUBLIC_ enum MAPISTATUS LoopAsyncNotifications(struct mapi_context *mapi_ctx,
+						struct mapi_notify_continue_callback_data *cb_data)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct mapi_session	*session;
+	int			ret;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx || !mapi_ctx->ev, MAPI_E_NOT_INITIALIZED, NULL);
+
+	while (true) {
+		for (session = mapi_ctx->session; session; session = session->next) {
+			if (session->async_notify) break;
+		}
+		if (!session) break;
+
+		/* The timer is freed by tevent if it fires */
+		mem_ctx = talloc_new(NULL);
+		OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+		if (cb_data) {
+			tevent_add_timer(mapi_ctx->ev, mem_ctx,
+					 tevent_timeval_current_ofs(cb_data->tv.tv_sec, cb_data->tv.tv_usec),
+					 mapi_async_notify_loop_timeout, NULL);
+		}
+		ret = tevent_loop_once(mapi_ctx->ev);
+		talloc_free(mem_ctx);
+		OPENCHANGE_RETVAL_IF(ret != 0, MAPI_E_CALL_FAILED, NULL);
+
+		if (cb_data && cb_data->callback && cb_data->callback(cb_data->data)) break;
+	}
+
+	return MAPI_E_SUCCESS;
+}
@@ -730,7 +730,6 @@ _PUBLIC_ enum MAPISTATUS CreateBookmark(mapi_object_t *obj_table,
 	uint32_t			size;
 	TALLOC_CTX			*mem_ctx;
 	mapi_object_table_t	       	*mapi_table;
-	mapi_object_bookmark_t		*bookmark;
 	uint8_t 			logon_id = 0;
 
 	/* Sanity checks */
@@ -774,18 +773,8 @@ _PUBLIC_ enum MAPISTATUS CreateBookmark(mapi_object_t *obj_table,
 	OPENCHANGE_RETVAL_IF(!mapi_table, MAPI_E_INVALID_PARAMETER, mem_ctx);
 
 	/* Store CreateBookmark data in mapi_object_table private_data */
-	bookmark = talloc_zero((TALLOC_CTX *)mapi_table->bookmark, mapi_object_bookmark_t);
-	mapi_table->bk_last++;
-	bookmark->index = mapi_table->bk_last;
-	bookmark->bin.cb = reply->bookmark.cb;
-	bookmark->bin.lpb = talloc_array((TALLOC_CTX *)bookmark, uint8_t, reply->bookmark.cb);
-	memcpy(bookmark->bin.lpb, reply->bookmark.lpb, reply->bookmark.cb);
-
-	DLIST_ADD(mapi_table->bookmark, bookmark);
-
-	*lpbkPosition = mapi_table->bk_last;
-
-	obj_table->private_data = mapi_table;
+	retval = mapi_object_bookmark_add(obj_table, &reply->bookmark, lpbkPosition);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
 
 	talloc_free(mapi_response);
 	talloc_free(mem_ctx);
@@ -838,64 +827,56 @@ _PUBLIC_ enum MAPISTATUS FreeBookmark(mapi_object_t *obj_table,
 	table = (mapi_object_table_t *)obj_table->private_data;
 	OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(bkPosition > table->bk_last, MAPI_E_INVALID_BOOKMARK, NULL);
+	OPENCHANGE_RETVAL_IF(bkPosition >= table->bk_slots_count, MAPI_E_INVALID_BOOKMARK, NULL);
 
-	bookmark = table->bookmark;
+	bookmark = table->bk_slots[bkPosition];
 	OPENCHANGE_RETVAL_IF(!bookmark, MAPI_E_INVALID_BOOKMARK, NULL);
 
 	if ((retval = mapi_object_get_logon_id(obj_table, &logon_id)) != MAPI_E_SUCCESS)
 		return retval;
 
 	mem_ctx = talloc_named(session, 0, "FreeBookmark");
+	size = 0;
 
-	while (bookmark) {
-		if (bookmark->index == bkPosition) {
-			if (bookmark->index == table->bk_last) {
-				table->bk_last--;
-			}
-			size = 0;
-
-			/* Fill the FreeBookmark operation */
-			request.bookmark.cb = bookmark->bin.cb;
-			size += sizeof (uint16_t);
-			request.bookmark.lpb = bookmark->bin.lpb;
-			size += bookmark->bin.cb;
-
-			/* Fill the MAPI_REQ request */
-			mapi_req = talloc_zero(mem_ctx, struct EcDoRpc_MAPI_REQ);
-			mapi_req->opnum = op_MAPI_FreeBookmark;
-			mapi_req->logon_id = logon_id;
-			mapi_req->handle_idx = 0;
-			mapi_req->u.mapi_FreeBookmark = request;
-			size += 5;
-
-			/* Fill the mapi_request structure */
-			mapi_request = talloc_zero(mem_ctx, struct mapi_request);
-			mapi_request->mapi_len = size + sizeof (uint32_t);
-			mapi_request->length = size;
-			mapi_request->mapi_req = mapi_req;
-			mapi_request->handles = talloc_array(mem_ctx, uint32_t, 1);
-			mapi_request->handles[0] = mapi_object_get_handle(obj_table);
-
-			status = emsmdb_transaction_wrapper(session, mem_ctx, mapi_request, &mapi_response);
-			OPENCHANGE_RETVAL_IF(!NT_STATUS_IS_OK(status), MAPI_E_CALL_FAILED, mem_ctx);
-			OPENCHANGE_RETVAL_IF(!mapi_response->mapi_repl, MAPI_E_CALL_FAILED, mem_ctx);
-			retval = mapi_response->mapi_repl->error_code;
-			OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
-
-			OPENCHANGE_CHECK_NOTIFICATION(session, mapi_response);
-
-			MAPIFreeBuffer(bookmark->bin.lpb);
-			DLIST_REMOVE(table->bookmark, bookmark);
-
-			talloc_free(mapi_response);
-			talloc_free(mem_ctx);
-
-			return MAPI_E_SUCCESS;
-		}
-		bookmark = bookmark->next;
+	/* Fill the FreeBookmark operation */
+	request.bookmark.cb = bookmark->bin.cb;
+	size += sizeof (uint16_t);
+	request.bookmark.lpb = bookmark->bin.lpb;
+	size += bookmark->bin.cb;
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(mem_ctx, struct EcDoRpc_MAPI_REQ);
+	mapi_req->opnum = op_MAPI_FreeBookmark;
+	mapi_req->logon_id = logon_id;
+	mapi_req->handle_idx = 0;
+	mapi_req->u.mapi_FreeBookmark = request;
+	size += 5;
+
+	/* Fill the mapi_request structure */
+	mapi_request = talloc_zero(mem_ctx, struct mapi_request);
+	mapi_request->mapi_len = size + sizeof (uint32_t);
+	mapi_request->length = size;
+	mapi_request->mapi_req = mapi_req;
+	mapi_request->handles = talloc_array(mem_ctx, uint32_t, 1);
+	mapi_request->handles[0] = mapi_object_get_handle(obj_table);
+
+	status = emsmdb_transaction_wrapper(session, mem_ctx, mapi_request, &mapi_response);
+	OPENCHANGE_RETVAL_IF(!NT_STATUS_IS_OK(status), MAPI_E_CALL_FAILED, mem_ctx);
+	OPENCHANGE_RETVAL_IF(!mapi_response->mapi_repl, MAPI_E_CALL_FAILED, mem_ctx);
+	retval = mapi_response->mapi_repl->error_code;
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	OPENCHANGE_CHECK_NOTIFICATION(session, mapi_response);
+
+	if (bkPosition == table->bk_last) {
+		table->bk_last--;
 	}
+	mapi_object_bookmark_del(obj_table, bkPosition);
+
+	talloc_free(mapi_response);
 	talloc_free(mem_ctx);
-	return MAPI_E_INVALID_BOOKMARK;
+
+	return MAPI_E_SUCCESS;
 }
 
 
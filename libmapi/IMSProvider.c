@@ -45,7 +45,8 @@ static NTSTATUS provider_rpc_connection(TALLOC_CTX *parent_ctx,
 					const char *binding,
 					struct cli_credentials *credentials,
 					const struct ndr_interface_table *table,
-					struct loadparm_context *lp_ctx)
+					struct loadparm_context *lp_ctx,
+					struct tevent_context *shared_ev)
 {
 	NTSTATUS		status;
 	struct tevent_context	*ev;
@@ -55,8 +56,16 @@ static NTSTATUS provider_rpc_connection(TALLOC_CTX *parent_ctx,
 		return NT_STATUS_INVALID_PARAMETER;
 	}
 
-	ev = tevent_context_init(parent_ctx);
-	tevent_loop_allow_nesting(ev);
+	/* The connection keeps the shared event context alive */
+	if (shared_ev) {
+		ev = talloc_reference(parent_ctx, shared_ev);
+	} else {
+		ev = tevent_context_init(parent_ctx);
+		if (ev) {
+			tevent_loop_allow_nesting(ev);
+		}
+	}
+	if (!ev) return NT_STATUS_NO_MEMORY;
 
 	status = dcerpc_pipe_connect(parent_ctx, 
 				     p, binding, table,
@@ -74,6 +83,181 @@ static NTSTATUS provider_rpc_connection(TALLOC_CTX *parent_ctx,
 #pragma GCC diagnostic warning "-Wdeprecated-declarations"
 
 
+/*
+ * A DCE/RPC connection shared by the sessions of a MAPI context
+ * connecting to the same server and interface with the same
+ * credentials. Each session gets its own context handle from
+ * EcDoConnectEx or NspiBind over it.
+ */
+struct mapi_connection {
+	struct mapi_connection			*prev;
+	struct mapi_connection			*next;
+	struct mapi_context			*mapi_ctx;
+	char					*binding;
+	char					*principal;
+	const struct ndr_interface_table	*table;
+	struct dcerpc_pipe			*pipe;
+	uint32_t				users;
+	time_t					idle_since;
+	bool					orphan;	/* the context is gone */
+};
+
+/* Allocated under each provider using a shared connection */
+struct mapi_connection_lease {
+	struct mapi_connection	*conn;
+};
+
+static bool mapi_connection_is_idle(struct mapi_connection *conn)
+{
+	struct mapi_context	*mapi_ctx = conn->mapi_ctx;
+
+	if (conn->users) return false;
+	if (!mapi_ctx->connection_pool || !mapi_ctx->connection_idle_timeout) return true;
+	if (!dcerpc_binding_handle_is_connected(conn->pipe->binding_handle)) return true;
+
+	return (time(NULL) - conn->idle_since >= mapi_ctx->connection_idle_timeout);
+}
+
+static int mapi_connection_lease_dtor(struct mapi_connection_lease *lease)
+{
+	struct mapi_connection	*conn = lease->conn;
+
+	/* Providers release their context handle before their lease */
+	conn->users--;
+	conn->idle_since = time(NULL);
+
+	if (conn->orphan) {
+		if (!conn->users) talloc_free(conn);
+	} else if (mapi_connection_is_idle(conn)) {
+		DLIST_REMOVE(conn->mapi_ctx->connections, conn);
+		talloc_free(conn);
+	}
+
+	return 0;
+}
+
+/**
+   \details Close the shared connections of a MAPI context no session
+   has been using for the idle timeout
+
+   Idle connections are also closed whenever a session of the context
+   logs on. Long running processes may call this function
+   periodically to close them sooner.
+
+   \param mapi_ctx pointer to the MAPI context
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_INITIALIZED
+
+   \sa SetMAPIConnectionPool
+ */
+_PUBLIC_ enum MAPISTATUS ReleaseIdleConnections(struct mapi_context *mapi_ctx)
+{
+	struct mapi_connection	*conn;
+	struct mapi_connection	*next;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	for (conn = mapi_ctx->connections; conn; conn = next) {
+		next = conn->next;
+		if (mapi_connection_is_idle(conn)) {
+			DLIST_REMOVE(mapi_ctx->connections, conn);
+			talloc_free(conn);
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/*
+ * Called by MAPIUninitialize before the sessions are freed: the
+ * connections they still use are freed with their last session
+ */
+void mapi_connection_pool_free(struct mapi_context *mapi_ctx)
+{
+	struct mapi_connection	*conn;
+
+	while ((conn = mapi_ctx->connections)) {
+		DLIST_REMOVE(mapi_ctx->connections, conn);
+		if (conn->users) {
+			conn->orphan = true;
+		} else {
+			talloc_free(conn);
+		}
+	}
+}
+
+/*
+ * Get a connection for a provider: a new one owned by mem_ctx, or a
+ * shared one when the connection pool of the context is enabled
+ */
+static NTSTATUS provider_pipe_connect(struct mapi_context *mapi_ctx,
+				      TALLOC_CTX *mem_ctx,
+				      struct dcerpc_pipe **p,
+				      const char *binding,
+				      struct cli_credentials *credentials,
+				      const struct ndr_interface_table *table)
+{
+	NTSTATUS			status;
+	struct mapi_connection		*conn;
+	struct mapi_connection_lease	*lease;
+	const char			*principal;
+
+	if (!mapi_ctx->connection_pool || !binding) {
+		return provider_rpc_connection(mem_ctx, p, binding, credentials, table, mapi_ctx->lp_ctx, mapi_ctx->ev);
+	}
+
+	ReleaseIdleConnections(mapi_ctx);
+
+	principal = cli_credentials_get_unparsed_name(credentials, mem_ctx);
+	if (!principal) return NT_STATUS_NO_MEMORY;
+
+	for (conn = mapi_ctx->connections; conn; conn = conn->next) {
+		if (conn->table == table && !strcmp(conn->binding, binding) &&
+		    !strcmp(conn->principal, principal) &&
+		    (!mapi_ctx->ev || dcerpc_event_context(conn->pipe) == mapi_ctx->ev) &&
+		    dcerpc_binding_handle_is_connected(conn->pipe->binding_handle)) {
+			break;
+		}
+	}
+
+	if (!conn) {
+		/* Not under the context: sessions may outlive it in MAPIUninitialize */
+		conn = talloc_zero(NULL, struct mapi_connection);
+		if (!conn) return NT_STATUS_NO_MEMORY;
+		conn->mapi_ctx = mapi_ctx;
+		conn->binding = talloc_strdup(conn, binding);
+		conn->principal = talloc_strdup(conn, principal);
+		conn->table = table;
+
+		status = provider_rpc_connection(conn, &conn->pipe, binding, credentials, table, mapi_ctx->lp_ctx, mapi_ctx->ev);
+		if (!NT_STATUS_IS_OK(status)) {
+			talloc_free(conn);
+			return status;
+		}
+		DLIST_ADD(mapi_ctx->connections, conn);
+	} else {
+		OC_DEBUG(5, "Sharing connection to %s", binding);
+	}
+
+	lease = talloc_zero(mem_ctx, struct mapi_connection_lease);
+	if (!lease) {
+		if (!conn->users) {
+			DLIST_REMOVE(mapi_ctx->connections, conn);
+			talloc_free(conn);
+		}
+		return NT_STATUS_NO_MEMORY;
+	}
+	lease->conn = conn;
+	conn->users++;
+	talloc_set_destructor(lease, mapi_connection_lease_dtor);
+
+	*p = conn->pipe;
+
+	return NT_STATUS_OK;
+}
+
+
 /**
    \details Build the binding string and flags given profile and
    global options.
@@ -117,6 +301,30 @@ static char *build_binding_string(struct mapi_context *mapi_ctx,
 	return binding;
 }
 
+/**
+   \details Store the NSPI server returned by RfrGetNewDSA in the
+   profile, so the logons until it expires skip the referral
+ */
+static void cache_nspi_server(struct mapi_context *mapi_ctx,
+			      struct mapi_profile *profile,
+			      const char *server)
+{
+	char	*expiry;
+
+	profile->nspi_server = talloc_strdup(profile, server);
+	profile->nspi_server_expiry = time(NULL) + mapi_ctx->profile_cache_ttl;
+
+	if (mapi_ctx->profiledb_readonly) return;
+
+	expiry = talloc_asprintf(profile, "%llu", (unsigned long long)profile->nspi_server_expiry);
+	if (!expiry) return;
+
+	mapi_profile_modify_string_attr(mapi_ctx, profile->profname, "NspiServer", server);
+	mapi_profile_modify_string_attr(mapi_ctx, profile->profname, "NspiServerExpiry", expiry);
+	talloc_free(expiry);
+}
+
+
 /**
    \details Returns the name of an NSPI server
 
@@ -159,7 +367,7 @@ _PUBLIC_ enum MAPISTATUS RfrGetNewDSA(struct mapi_context *mapi_ctx,
 	profile = session->profile;
 
 	binding = build_binding_string(mapi_ctx, mem_ctx, server, profile);
-	status = provider_rpc_connection(mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_ds_rfr, mapi_ctx->lp_ctx);
+	status = provider_pipe_connect(mapi_ctx, mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_ds_rfr);
 	talloc_free(binding);
 	
 	if (!NT_STATUS_IS_OK(status)) {
@@ -218,7 +426,7 @@ _PUBLIC_ enum MAPISTATUS RfrGetFQDNFromLegacyDN(struct mapi_context *mapi_ctx, s
 	*serverFQDN = NULL;
 
 	binding = build_binding_string(mapi_ctx, mem_ctx, profile->server, profile);
-	status = provider_rpc_connection(mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_ds_rfr, mapi_ctx->lp_ctx);
+	status = provider_pipe_connect(mapi_ctx, mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_ds_rfr);
 	talloc_free(binding);
 
 	OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_CONNECTION_REFUSED), ecRpcFailed, NULL);
@@ -258,6 +466,7 @@ enum MAPISTATUS Logon(struct mapi_session *session,
 	char			*server;
 	int			retval = 0;
 	enum MAPISTATUS		mapistatus;
+	bool			cached;
 
 	/*Sanity checks */
 	OPENCHANGE_RETVAL_IF(!session, MAPI_E_NOT_INITIALIZED, NULL);
@@ -270,7 +479,7 @@ enum MAPISTATUS Logon(struct mapi_session *session,
 	case PROVIDER_ID_EMSMDB:
 	emsmdb_retry:
 		binding = build_binding_string(mapi_ctx, mem_ctx, profile->server, profile);
-		status = provider_rpc_connection(mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_emsmdb, mapi_ctx->lp_ctx);
+		status = provider_pipe_connect(mapi_ctx, mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_emsmdb);
 		talloc_free(binding);
 		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_CONNECTION_REFUSED), ecRpcFailed, NULL);
 		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_HOST_UNREACHABLE), ecRpcFailed, NULL);
@@ -290,6 +499,10 @@ enum MAPISTATUS Logon(struct mapi_session *session,
 		if (retval == ecNotEncrypted) {
 			profile->seal = true;
 			retval = 0;
+			/* Save the next logons the failed attempt */
+			if (mapi_ctx->profile_cache_ttl && !mapi_ctx->profiledb_readonly) {
+				mapi_profile_modify_string_attr(mapi_ctx, profile->profname, "seal", "TRUE");
+			}
 			goto emsmdb_retry;
 		}
 		OPENCHANGE_RETVAL_IF(!provider->ctx, MAPI_E_LOGON_FAILED, NULL);
@@ -303,6 +516,10 @@ enum MAPISTATUS Logon(struct mapi_session *session,
 			OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_IO_TIMEOUT), ecRpcFailed, NULL);
 			OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND), ecRpcFailed, NULL);
 			OPENCHANGE_RETVAL_IF(!NT_STATUS_IS_OK(status), MAPI_E_LOGON_FAILED, NULL);
+			/* The secondary context belongs to the session, not to a shared connection */
+			if (mapi_ctx->connection_pool) {
+				talloc_steal(mem_ctx, prov_ctx->async_rpc_connection);
+			}
 			mapistatus = emsmdb_async_connect(prov_ctx);
 			OPENCHANGE_RETVAL_IF(mapistatus, mapistatus, NULL);
 
@@ -315,16 +532,32 @@ enum MAPISTATUS Logon(struct mapi_session *session,
 
 		break;
 	case PROVIDER_ID_NSPI:
-		/* Call RfrGetNewDSA prior any NSPI call */
-		mapistatus = RfrGetNewDSA(mapi_ctx, session, profile->server, profile->mailbox, &server);
-		if (mapistatus != MAPI_E_SUCCESS) {
-			binding = build_binding_string(mapi_ctx, mem_ctx, profile->server, profile);
+	nspi_retry:
+		/* Reuse the NSPI server resolved by a previous logon */
+		cached = mapi_ctx->profile_cache_ttl && profile->nspi_server &&
+			profile->nspi_server_expiry > time(NULL);
+		if (cached) {
+			binding = build_binding_string(mapi_ctx, mem_ctx, profile->nspi_server, profile);
 		} else {
-			binding = build_binding_string(mapi_ctx, mem_ctx, server, profile);
-			talloc_free(server);
+			/* Call RfrGetNewDSA prior any NSPI call */
+			mapistatus = RfrGetNewDSA(mapi_ctx, session, profile->server, profile->mailbox, &server);
+			if (mapistatus != MAPI_E_SUCCESS) {
+				binding = build_binding_string(mapi_ctx, mem_ctx, profile->server, profile);
+			} else {
+				binding = build_binding_string(mapi_ctx, mem_ctx, server, profile);
+				if (mapi_ctx->profile_cache_ttl) {
+					cache_nspi_server(mapi_ctx, profile, server);
+				}
+				talloc_free(server);
+			}
 		}
-		status = provider_rpc_connection(mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_nsp, mapi_ctx->lp_ctx);
+		status = provider_pipe_connect(mapi_ctx, mem_ctx, &pipe, binding, profile->credentials, &ndr_table_exchange_nsp);
 		talloc_free(binding);
+		if (cached && !NT_STATUS_IS_OK(status)) {
+			/* The server may have moved, ask for a referral */
+			profile->nspi_server = NULL;
+			goto nspi_retry;
+		}
 		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_CONNECTION_REFUSED), ecRpcFailed, NULL);
 		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_HOST_UNREACHABLE), ecRpcFailed, NULL);
 		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_PORT_UNREACHABLE), ecRpcFailed, NULL);
@@ -437,8 +670,8 @@ _PUBLIC_ enum MAPISTATUS RegisterNotification(struct mapi_session *session)
 	struct emsmdb_context	*emsmdb;
 	TALLOC_CTX		*mem_ctx;
 	struct NOTIFKEY		*lpKey;
-	static uint8_t		rand = 0;
-	static uint8_t		attempt = 0;
+	uint8_t			rand = 0;
+	uint8_t			attempt = 0;
 	
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!session, MAPI_E_INVALID_PARAMETER, NULL);
@@ -477,7 +710,6 @@ retry:
 		}
 	}
 
-	attempt = 0;
 	talloc_free(lpKey);
 	return MAPI_E_SUCCESS;
 }
@@ -518,3 +750,41 @@ _PUBLIC_ enum MAPISTATUS RegisterAsyncNotification(struct mapi_session *session,
 	return MAPI_E_SUCCESS;
 }
 
+
+
+/**
+   \details Set the timeout of the EMSMDB requests of a session
+
+   A request which gets no reply within the timeout fails with
+   MAPI_E_CALL_FAILED, so a caller can bound the time it waits on a
+   slow or unreachable server.
+
+   With the connection pool enabled, the timeout applies to all the
+   sessions sharing the connection of this one.
+
+   \param session the session to set the timeout for
+   \param timeout the timeout in seconds
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: session is NULL or timeout is 0
+   - MAPI_E_SESSION_LIMIT: the session is not logged on
+*/
+_PUBLIC_ enum MAPISTATUS SetMAPIRequestTimeout(struct mapi_session *session, uint32_t timeout)
+{
+	struct emsmdb_context	*emsmdb;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!timeout, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!session->emsmdb, MAPI_E_SESSION_LIMIT, NULL);
+
+	emsmdb = (struct emsmdb_context *)session->emsmdb->ctx;
+	OPENCHANGE_RETVAL_IF(!emsmdb || !emsmdb->rpc_connection, MAPI_E_SESSION_LIMIT, NULL);
+
+	dcerpc_binding_handle_set_timeout(emsmdb->rpc_connection->binding_handle, timeout);
+
+	return MAPI_E_SUCCESS;
+}
@@ -1353,6 +1353,94 @@ _PUBLIC_ enum MAPISTATUS SaveChangesMessage(mapi_object_t *parent,
 	return MAPI_E_SUCCESS;
 }
 
+
+struct SaveChangesMessage_batch {
+	mapi_object_t			*obj_message;
+};
+
+static enum MAPISTATUS SaveChangesMessage_batch_reply(struct mapi_batch *batch,
+						      struct EcDoRpc_MAPI_REPL *mapi_repl,
+						      uint32_t handle, void *private_data)
+{
+	struct SaveChangesMessage_batch	*ctx = (struct SaveChangesMessage_batch *) private_data;
+
+	/* store the message_id */
+	mapi_object_set_id(ctx->obj_message, mapi_repl->u.mapi_SaveChangesMessage.MessageId);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the saving of a message in a batch
+
+   The message is saved when the batch is flushed, obj_message may be
+   a message opened or created by a call queued earlier in the same
+   batch.
+
+   \param batch pointer to the batch
+   \param parent the parent object for the message
+   \param obj_message the message to save
+   \param SaveFlags specify how the save operation behaves, see
+   SaveChangesMessage
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
+
+   \return MAPI_E_SUCCESS if the call was queued, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: a parameter is missing or parent does
+     not belong to the batch session
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the batch is full and must be
+     flushed first
+
+   \sa mapi_batch_begin, mapi_batch_flush, SaveChangesMessage
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_SaveChangesMessage(struct mapi_batch *batch,
+						       mapi_object_t *parent,
+						       mapi_object_t *obj_message,
+						       uint8_t SaveFlags,
+						       enum MAPISTATUS *status)
+{
+	struct EcDoRpc_MAPI_REQ		*mapi_req;
+	struct SaveChangesMessage_batch	*ctx;
+	enum MAPISTATUS			retval;
+	uint8_t				logon_id;
+	uint8_t				handle_idx;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch || !parent || !obj_message, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF((SaveFlags != 0x9) && (SaveFlags != 0xA) && 
+			     (SaveFlags != 0xC), MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(mapi_object_get_session(parent) != mapi_batch_get_session(batch),
+			     MAPI_E_INVALID_PARAMETER, NULL);
+
+	if ((retval = mapi_object_get_logon_id(parent, &logon_id)) != MAPI_E_SUCCESS)
+		return retval;
+
+	retval = mapi_batch_get_handle_idx(batch, obj_message, &handle_idx);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(NULL, struct EcDoRpc_MAPI_REQ);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	mapi_req->opnum = op_MAPI_SaveChangesMessage;
+	mapi_req->logon_id = logon_id;
+	mapi_req->u.mapi_SaveChangesMessage.handle_idx = handle_idx;
+	mapi_req->u.mapi_SaveChangesMessage.SaveFlags = SaveFlags;
+
+	ctx = talloc_zero(mapi_req, struct SaveChangesMessage_batch);
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	ctx->obj_message = obj_message;
+
+	retval = mapi_batch_queue(batch, parent, NULL, mapi_req, SaveChangesMessage_batch_reply,
+				  ctx, status, NULL);
+	OPENCHANGE_RETVAL_IF(retval, retval, mapi_req);
+
+	return MAPI_E_SUCCESS;
+}
+
 /**
    \details Sends the specified Message object out for message
    delivery.
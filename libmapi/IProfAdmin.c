@@ -34,17 +34,103 @@
  * Private functions
  */
 
+#if defined(HAVE_PTHREADS)
+/* The MAPI contexts of a process opening the same profile database
+   share its tdb handle, which is not thread safe: serialize the ldb
+   operations of all contexts */
+static pthread_mutex_t profile_db_lock = PTHREAD_MUTEX_INITIALIZER;
+#define	PROFILE_DB_LOCK()	pthread_mutex_lock(&profile_db_lock)
+#define	PROFILE_DB_UNLOCK()	pthread_mutex_unlock(&profile_db_lock)
+#else
+#define	PROFILE_DB_LOCK()
+#define	PROFILE_DB_UNLOCK()
+#endif
+
+/* A profile record read from the store. OpenProfile reuses it until
+   it expires instead of searching the store again */
+struct mapi_profile_cache {
+	struct mapi_profile_cache	*prev;
+	struct mapi_profile_cache	*next;
+	char				*profname;
+	struct ldb_message		*msg;
+	time_t				expires;
+};
+
+static struct ldb_message *profile_cache_lookup(struct mapi_context *mapi_ctx,
+						const char *profname)
+{
+	struct mapi_profile_cache	*el;
+
+	for (el = mapi_ctx->profile_cache; el; el = el->next) {
+		if (strcmp(el->profname, profname)) continue;
+
+		if (el->expires > time(NULL)) return el->msg;
+
+		DLIST_REMOVE(mapi_ctx->profile_cache, el);
+		talloc_free(el);
+		break;
+	}
+
+	return NULL;
+}
+
+static void profile_cache_add(struct mapi_context *mapi_ctx,
+			      const char *profname,
+			      struct ldb_message *msg)
+{
+	struct mapi_profile_cache	*el;
+
+	el = talloc_zero(mapi_ctx->mem_ctx, struct mapi_profile_cache);
+	if (!el) return;
+
+	el->profname = talloc_strdup(el, profname);
+	el->msg = talloc_steal(el, msg);
+	el->expires = time(NULL) + mapi_ctx->profile_cache_ttl;
+	DLIST_ADD(mapi_ctx->profile_cache, el);
+}
+
+/**
+ * Drop all the profiles from the cache of the context
+ */
+void mapi_profile_cache_flush(struct mapi_context *mapi_ctx)
+{
+	struct mapi_profile_cache	*el;
+
+	while ((el = mapi_ctx->profile_cache)) {
+		DLIST_REMOVE(mapi_ctx->profile_cache, el);
+		talloc_free(el);
+	}
+}
+
+/**
+ * Drop a profile from the cache of the context once it is modified
+ */
+static void profile_cache_forget(struct mapi_context *mapi_ctx,
+				 const char *profname)
+{
+	struct mapi_profile_cache	*el;
+
+	for (el = mapi_ctx->profile_cache; el; el = el->next) {
+		if (!strcmp(el->profname, profname)) {
+			DLIST_REMOVE(mapi_ctx->profile_cache, el);
+			talloc_free(el);
+			return;
+		}
+	}
+}
+
 /**
  * Load a MAPI profile into a mapi_profile struct
  */
-static enum MAPISTATUS ldb_load_profile(TALLOC_CTX *mem_ctx,
-					struct ldb_context *ldb_ctx,
+static enum MAPISTATUS ldb_load_profile(struct mapi_context *mapi_ctx,
+					TALLOC_CTX *mem_ctx,
 					struct mapi_profile *profile,
 					const char *profname, const char *password)
 {
 	int			ret;
+	struct ldb_context	*ldb_ctx = mapi_ctx->ldb_ctx;
 	enum ldb_scope		scope = LDB_SCOPE_SUBTREE;
-	struct ldb_result	*res;
+	struct ldb_result	*res = NULL;
 	struct ldb_message	*msg;
 	const char * const	attrs[] = { "*", NULL };
 
@@ -53,41 +139,51 @@ static enum MAPISTATUS ldb_load_profile(TALLOC_CTX *mem_ctx,
 	profile->profname = talloc_strdup(mem_ctx, profname);
 	if (!profile->profname) return MAPI_E_NOT_ENOUGH_RESOURCES;
 
-	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs, "(cn=%s)(cn=Profiles)", profile->profname);
-	if (ret != LDB_SUCCESS) return MAPI_E_NOT_FOUND;
+	msg = mapi_ctx->profile_cache_ttl ? profile_cache_lookup(mapi_ctx, profname) : NULL;
+	if (!msg) {
+		PROFILE_DB_LOCK();
+		ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs, "(cn=%s)(cn=Profiles)", profile->profname);
+		PROFILE_DB_UNLOCK();
+		if (ret != LDB_SUCCESS) return MAPI_E_NOT_FOUND;
+
+		/* profile not found */
+		if (!res->count) {
+			talloc_free(res);
+			return MAPI_E_NOT_FOUND;
+		}
 
-	/* profile not found */
-	if (!res->count) {
-		talloc_free(res);
-		return MAPI_E_NOT_FOUND;
-	}
+		/* more than one profile */
+		if (res->count > 1) {
+			talloc_free(res);
+			return MAPI_E_COLLISION;
+		}
 
-	/* more than one profile */
-	if (res->count > 1) {
-		talloc_free(res);
-		return MAPI_E_COLLISION;
+		msg = res->msgs[0];
+		if (mapi_ctx->profile_cache_ttl) {
+			profile_cache_add(mapi_ctx, profname, msg);
+		}
 	}
 
-	/* fills in profile with query result */
-	msg = res->msgs[0];
-
-	profile->username = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "username", NULL));
-	profile->password = password ? password : talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "password", NULL));
-	profile->workstation = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "workstation", NULL));
-	profile->realm = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "realm", NULL));
-	profile->domain = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "domain", NULL));
-	profile->mailbox = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "EmailAddress", NULL));
-	profile->homemdb = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "HomeMDB", NULL));
-	profile->localaddr = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "localaddress", NULL));
-	profile->server = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "binding", NULL));
+	/* fills in profile with the record, which the cache may still hold */
+	profile->username = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "username", NULL));
+	profile->password = password ? password : talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "password", NULL));
+	profile->workstation = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "workstation", NULL));
+	profile->realm = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "realm", NULL));
+	profile->domain = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "domain", NULL));
+	profile->mailbox = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "EmailAddress", NULL));
+	profile->homemdb = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "HomeMDB", NULL));
+	profile->localaddr = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "localaddress", NULL));
+	profile->server = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "binding", NULL));
 	profile->seal = ldb_msg_find_attr_as_bool(msg, "seal", false);
-	profile->org = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "Organization", NULL));
-	profile->ou = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "OrganizationUnit", NULL));
+	profile->org = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "Organization", NULL));
+	profile->ou = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "OrganizationUnit", NULL));
 	profile->codepage = ldb_msg_find_attr_as_int(msg, "codepage", 0);
 	profile->language = ldb_msg_find_attr_as_int(msg, "language", 0);
 	profile->method = ldb_msg_find_attr_as_int(msg, "method", 0);
 	profile->exchange_version = ldb_msg_find_attr_as_int(msg, "exchange_version", 0);
-	profile->kerberos = talloc_steal(profile, ldb_msg_find_attr_as_string(msg, "kerberos", NULL));
+	profile->kerberos = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "kerberos", NULL));
+	profile->nspi_server = talloc_strdup(profile, ldb_msg_find_attr_as_string(msg, "NspiServer", NULL));
+	profile->nspi_server_expiry = (time_t)ldb_msg_find_attr_as_uint64(msg, "NspiServerExpiry", 0);
 
 	talloc_free(res);
 
@@ -112,7 +208,9 @@ static enum MAPISTATUS ldb_clear_default_profile(struct mapi_context *mapi_ctx,
 	ldb_ctx = mapi_ctx->ldb_ctx;
 
 	basedn = ldb_dn_new(ldb_ctx, ldb_ctx, "CN=Profiles");
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, basedn, scope, attrs, "(cn=*)");
+	PROFILE_DB_UNLOCK();
 	
 	if (ret != LDB_SUCCESS) return MAPI_E_NOT_FOUND;
 	if (!res->count) return MAPI_E_NOT_FOUND;
@@ -125,7 +223,9 @@ static enum MAPISTATUS ldb_clear_default_profile(struct mapi_context *mapi_ctx,
 			message = talloc_steal(mem_ctx, msg);
 			message->elements[0].flags = LDB_FLAG_MOD_DELETE;
 
+			PROFILE_DB_LOCK();
 			ret = ldb_modify(ldb_ctx, message);
+			PROFILE_DB_UNLOCK();
 			talloc_free(message);
 		}
 	}
@@ -151,8 +251,10 @@ static enum MAPISTATUS ldb_test_password(struct mapi_context *mapi_ctx,
 
 	ldb_ctx = mapi_ctx->ldb_ctx;
 	
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, NULL, scope, attrs, 
 					 "(cn=%s)(cn=Profiles)", profile);
+	PROFILE_DB_UNLOCK();
 
 	if (ret != LDB_SUCCESS) return MAPI_E_NO_SUPPORT;
 	if (!res->count) return MAPI_E_NOT_FOUND;
@@ -189,8 +291,10 @@ static enum MAPISTATUS ldb_create_profile(TALLOC_CTX *mem_ctx,
 		return MAPI_E_BAD_VALUE;
 
 	/* Does the profile already exists? */
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), 
 					 scope, attrs, "(cn=%s)(cn=Profiles)", profname);
+	PROFILE_DB_UNLOCK();
 	if (ret == LDB_SUCCESS && res && res->msgs) return MAPI_E_NO_ACCESS;
 
 	/*
@@ -220,7 +324,9 @@ static enum MAPISTATUS ldb_create_profile(TALLOC_CTX *mem_ctx,
 	vals[1][0].data = (uint8_t *)talloc_strdup(mem_ctx, profname);
 	vals[1][0].length = strlen(profname);
 
+	PROFILE_DB_LOCK();
 	ret = ldb_add(ldb_ctx, &msg);
+	PROFILE_DB_UNLOCK();
 
 	if (ret != LDB_SUCCESS) return MAPI_E_NO_SUPPORT;
 
@@ -239,10 +345,14 @@ static enum MAPISTATUS ldb_delete_profile(TALLOC_CTX *mem_ctx,
 	const char * const	attrs[] = { "*", NULL };
 	int			ret;
 
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs, "(cn=%s)(cn=Profiles)", profname);
+	PROFILE_DB_UNLOCK();
 	if (!res->msgs) return MAPI_E_NOT_FOUND;
 
+	PROFILE_DB_LOCK();
 	ret = ldb_delete(ldb_ctx, res->msgs[0]->dn);
+	PROFILE_DB_UNLOCK();
 	if (ret != LDB_SUCCESS) return MAPI_E_NOT_FOUND;
 	
 	return MAPI_E_SUCCESS;
@@ -274,8 +384,10 @@ static enum MAPISTATUS ldb_copy_profile(TALLOC_CTX *mem_ctx,
 	struct ldb_dn			*basedn;
 
 	/* Step 1. Load the source profile */
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs,
 			 "(cn=%s)(cn=Profiles)", profname_src);
+	PROFILE_DB_UNLOCK();
 	/* profile not found */
 	if (ret != LDB_SUCCESS) return MAPI_E_NOT_FOUND;
 	/* more than one profile */
@@ -285,8 +397,10 @@ static enum MAPISTATUS ldb_copy_profile(TALLOC_CTX *mem_ctx,
 	msg = res->msgs[0];
 
 	/* Step 2. Encure the desintation profile doesn't exist */
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res_dest, ldb_get_default_basedn(ldb_ctx), scope, attrs,
 			 "(cn=%s)(cn=Profiles)", profname_dest);
+	PROFILE_DB_UNLOCK();
 	/* If profile exists or there is more than one */
 	if (ret == LDB_SUCCESS && res_dest->count) return MAPI_E_COLLISION;
 
@@ -307,7 +421,9 @@ static enum MAPISTATUS ldb_copy_profile(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Step 4. Copy the profile */
+	PROFILE_DB_LOCK();
 	ret = ldb_add(ldb_ctx, msg);
+	PROFILE_DB_UNLOCK();
 	/* talloc_free(basedn); */
 	
 	if (ret != LDB_SUCCESS) return MAPI_E_NO_SUPPORT;
@@ -395,7 +511,9 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_add_string_attr(struct mapi_context *mapi_
 	ldb_ctx = mapi_ctx->ldb_ctx;
 
 	/* Retrieve the profile from the database */
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs, "(cn=%s)(cn=Profiles)", profile);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_BAD_VALUE, mem_ctx);
 
 	/* Preparing for the transaction */
@@ -415,8 +533,11 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_add_string_attr(struct mapi_context *mapi_
 	vals[0][0].data = (uint8_t *)talloc_strdup(mem_ctx, value);
 	vals[0][0].length = strlen(value);
 
+	PROFILE_DB_LOCK();
 	ret = ldb_modify(ldb_ctx, &msg);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NO_SUPPORT, mem_ctx);
+	profile_cache_forget(mapi_ctx, profile);
 	
 	talloc_free(mem_ctx);
 	return MAPI_E_SUCCESS;
@@ -454,7 +575,9 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_modify_string_attr(struct mapi_context *ma
 	mem_ctx = talloc_named(mapi_ctx->mem_ctx, 0, "mapi_profile_modify_string_attr");
 
 	/* Retrieve the profile from the database */
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs, "(cn=%s)(cn=Profiles)", profname);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_BAD_VALUE, mem_ctx);
 
 	/* Preparing for the transaction */
@@ -474,8 +597,11 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_modify_string_attr(struct mapi_context *ma
 	vals[0][0].data = (uint8_t *)talloc_strdup(mem_ctx, value);
 	vals[0][0].length = strlen(value);
 
+	PROFILE_DB_LOCK();
 	ret = ldb_modify(ldb_ctx, &msg);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NO_SUPPORT, mem_ctx);
+	profile_cache_forget(mapi_ctx, profname);
 
 	talloc_free(mem_ctx);
 	
@@ -518,7 +644,9 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_delete_string_attr(struct mapi_context *ma
 	mem_ctx = talloc_named(mapi_ctx->mem_ctx, 0, "mapi_profile_delete_string_attr");
 
 	/* Retrieve the profile from the database */
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx), scope, attrs, "(cn=%s)(cn=Profiles)", profname);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_BAD_VALUE, mem_ctx);
 
 	/* Preparing for the transaction */
@@ -538,8 +666,11 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_delete_string_attr(struct mapi_context *ma
 	vals[0][0].data = (uint8_t *)talloc_strdup(mem_ctx, value);
 	vals[0][0].length = strlen(value);
 
+	PROFILE_DB_LOCK();
 	ret = ldb_modify(ldb_ctx, &msg);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NO_SUPPORT, mem_ctx);
+	profile_cache_forget(mapi_ctx, profname);
 
 	talloc_free(mem_ctx);
 	
@@ -548,10 +679,11 @@ _PUBLIC_ enum MAPISTATUS mapi_profile_delete_string_attr(struct mapi_context *ma
 
 /*
  * Private function which opens the profile store
- * Should only be called within MAPIInitialize
+ * Should only be called within MAPIInitialize and
+ * SetMAPIProfileStoreReadOnly
  */
 enum MAPISTATUS OpenProfileStore(TALLOC_CTX *mem_ctx, struct ldb_context **ldb_ctx, 
-				 const char *profiledb)
+				 const char *profiledb, bool readonly)
 {
 	int			ret;
 	struct ldb_context	*tmp_ctx;
@@ -569,7 +701,9 @@ enum MAPISTATUS OpenProfileStore(TALLOC_CTX *mem_ctx, struct ldb_context **ldb_c
 	tmp_ctx = ldb_init(mem_ctx, ev);
 	if (!tmp_ctx) return MAPI_E_NOT_ENOUGH_RESOURCES;
 
-	ret = ldb_connect(tmp_ctx, profiledb, 0, NULL);
+	PROFILE_DB_LOCK();
+	ret = ldb_connect(tmp_ctx, profiledb, readonly ? LDB_FLG_RDONLY : 0, NULL);
+	PROFILE_DB_UNLOCK();
 	if (ret != LDB_SUCCESS) return MAPI_E_NOT_FOUND;
 
 	*ldb_ctx = tmp_ctx;
@@ -634,7 +768,9 @@ _PUBLIC_ enum MAPISTATUS CreateProfileStore(const char *profiledb, const char *l
 	OPENCHANGE_RETVAL_IF(!ldb_ctx, MAPI_E_NOT_ENOUGH_RESOURCES, mem_ctx);
 
 	url = talloc_asprintf(mem_ctx, "tdb://%s", profiledb);
+	PROFILE_DB_LOCK();
 	ret = ldb_connect(ldb_ctx, url, 0, 0);
+	PROFILE_DB_UNLOCK();
 	talloc_free(url);
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NO_ACCESS, mem_ctx);
 
@@ -647,7 +783,9 @@ _PUBLIC_ enum MAPISTATUS CreateProfileStore(const char *profiledb, const char *l
 		struct ldb_message *normalized_msg;
 		ret = ldb_msg_normalize(ldb_ctx, mem_ctx, ldif->msg, &normalized_msg);
 		OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NO_ACCESS, mem_ctx);
+		PROFILE_DB_LOCK();
 		ret = ldb_add(ldb_ctx, normalized_msg);
+		PROFILE_DB_UNLOCK();
 		if (ret != LDB_SUCCESS) {
 			fclose(f);
 			OPENCHANGE_RETVAL_ERR(MAPI_E_NO_ACCESS, mem_ctx);
@@ -666,7 +804,9 @@ _PUBLIC_ enum MAPISTATUS CreateProfileStore(const char *profiledb, const char *l
 		struct ldb_message *normalized_msg;
 		ret = ldb_msg_normalize(ldb_ctx, mem_ctx, ldif->msg, &normalized_msg);
 		OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NO_ACCESS, mem_ctx);
+		PROFILE_DB_LOCK();
 		ret = ldb_add(ldb_ctx, normalized_msg);
+		PROFILE_DB_UNLOCK();
 		if (ret != LDB_SUCCESS) {
 			fclose(f);
 			OPENCHANGE_RETVAL_ERR(MAPI_E_NO_ACCESS, mem_ctx);
@@ -721,7 +861,7 @@ _PUBLIC_ enum MAPISTATUS OpenProfile(struct mapi_context *mapi_ctx,
 	mem_ctx = (TALLOC_CTX *) mapi_ctx;
 	
 	/* find the profile in ldb store */
-	retval = ldb_load_profile(mem_ctx, mapi_ctx->ldb_ctx, profile, profname, password);
+	retval = ldb_load_profile(mapi_ctx, mem_ctx, profile, profname, password);
 
 	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
 	profile->mapi_ctx = mapi_ctx;
@@ -916,6 +1056,7 @@ _PUBLIC_ enum MAPISTATUS DeleteProfile(struct mapi_context *mapi_ctx,
 	mem_ctx = talloc_named(mapi_ctx->mem_ctx, 0, "DeleteProfile");
 	retval = ldb_delete_profile(mem_ctx, mapi_ctx->ldb_ctx, profile);
 	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+	profile_cache_forget(mapi_ctx, profile);
 	talloc_free(mem_ctx);
 
 	return retval;
@@ -1224,6 +1365,7 @@ _PUBLIC_ enum MAPISTATUS RenameProfile(struct mapi_context *mapi_ctx,
 	/* Step 3. Rename the profile */
 	retval = ldb_rename_profile(mapi_ctx, mem_ctx, old_profile, profile);
 	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	profile_cache_forget(mapi_ctx, old_profile);
 
 	/* Step 4. Change name and cn */
 	msg = ldb_msg_new(mem_ctx);
@@ -1238,7 +1380,9 @@ _PUBLIC_ enum MAPISTATUS RenameProfile(struct mapi_context *mapi_ctx,
 	}
 
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_CORRUPT_STORE, NULL);
+	PROFILE_DB_LOCK();
 	ret = ldb_modify(mapi_ctx->ldb_ctx, msg);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_CORRUPT_STORE, NULL);
 
 	return MAPI_E_SUCCESS;
@@ -1278,7 +1422,7 @@ _PUBLIC_ enum MAPISTATUS SetDefaultProfile(struct mapi_context *mapi_ctx,
 
 	/* open profile */
 	profile = talloc_zero(mem_ctx, struct mapi_profile);
-	retval = ldb_load_profile(mem_ctx, mapi_ctx->ldb_ctx, profile, profname, NULL);
+	retval = ldb_load_profile(mapi_ctx, mem_ctx, profile, profname, NULL);
 	OPENCHANGE_RETVAL_IF(retval && retval != MAPI_E_INVALID_PARAMETER, retval, mem_ctx);
 
 	/* search any previous default profile and unset it */
@@ -1381,7 +1525,9 @@ _PUBLIC_ enum MAPISTATUS GetProfileTable(struct mapi_context *mapi_ctx,
 	mem_ctx = mapi_ctx->mem_ctx;
 
 	basedn = ldb_dn_new(ldb_ctx, ldb_ctx, "CN=Profiles");
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, basedn, scope, attrs, "(cn=*)");
+	PROFILE_DB_UNLOCK();
 	talloc_free(basedn);
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, NULL);
 
@@ -1464,7 +1610,9 @@ _PUBLIC_ enum MAPISTATUS GetProfileAttr(struct mapi_profile *profile,
 
 	basedn = ldb_dn_new(ldb_ctx, ldb_ctx, "CN=Profiles");
 
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, basedn, LDB_SCOPE_SUBTREE, attrs, "(cn=%s)", profile->profname);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, NULL);
 
 	msg = res->msgs[0];
@@ -1526,7 +1674,9 @@ _PUBLIC_ enum MAPISTATUS FindProfileAttr(struct mapi_profile *profile,
 
 	basedn = ldb_dn_new(ldb_ctx, ldb_ctx, "CN=Profiles");
 
+	PROFILE_DB_LOCK();
 	ret = ldb_search(ldb_ctx, mem_ctx, &res, basedn, LDB_SCOPE_SUBTREE, attrs, "(CN=%s)", profile->profname);
+	PROFILE_DB_UNLOCK();
 	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, res);
 	OPENCHANGE_RETVAL_IF(!res->count, MAPI_E_NOT_FOUND, res);
 
@@ -28,6 +28,64 @@
 */
 
 
+static void OpenMessage_reply(mapi_object_t *obj_message, struct mapi_session *session,
+			      uint8_t logon_id, mapi_handle_t handle,
+			      struct OpenMessage_repl *reply)
+{
+	mapi_object_message_t		*message;
+	struct SPropValue		lpProp;
+	const char			*tstring;
+	uint32_t			i;
+
+	/* Set object session and handle */
+	mapi_object_set_session(obj_message, session);
+	mapi_object_set_handle(obj_message, handle);
+	mapi_object_set_logon_id(obj_message, logon_id);
+
+	message = talloc_zero((TALLOC_CTX *)session, mapi_object_message_t);
+
+	tstring = get_TypedString(&reply->SubjectPrefix);
+	if (tstring) {
+		message->SubjectPrefix = talloc_strdup((TALLOC_CTX *)message, tstring);
+	}
+
+	tstring = get_TypedString(&reply->NormalizedSubject);
+	if (tstring) {
+		message->NormalizedSubject = talloc_strdup((TALLOC_CTX *)message, tstring);
+	}
+	
+
+	message->cValues = reply->RecipientColumns.cValues;
+	message->SRowSet.cRows = reply->RowCount;
+	message->SRowSet.aRow = talloc_array((TALLOC_CTX *)message, struct SRow, reply->RowCount + 1);
+
+	message->SPropTagArray.cValues = reply->RecipientColumns.cValues;
+	message->SPropTagArray.aulPropTag = talloc_steal(message, reply->RecipientColumns.aulPropTag);
+
+	for (i = 0; i < reply->RowCount; i++) {
+		emsmdb_get_SRow((TALLOC_CTX *)message,
+				&(message->SRowSet.aRow[i]), &message->SPropTagArray, 
+				reply->RecipientRows[i].RecipientRow.prop_count,
+				&reply->RecipientRows[i].RecipientRow.prop_values,
+				reply->RecipientRows[i].RecipientRow.layout, 1);
+
+		lpProp.ulPropTag = PR_RECIPIENT_TYPE;
+		lpProp.value.l = reply->RecipientRows[i].RecipientType;
+		SRow_addprop(&(message->SRowSet.aRow[i]), lpProp);
+
+		lpProp.ulPropTag = PR_INTERNET_CPID;
+		lpProp.value.l = reply->RecipientRows[i].CodePageId;
+		SRow_addprop(&(message->SRowSet.aRow[i]), lpProp);
+	}
+
+	/* add SPropTagArray elements we automatically append to SRow */
+	SPropTagArray_add((TALLOC_CTX *)message, &message->SPropTagArray, PR_RECIPIENT_TYPE);
+	SPropTagArray_add((TALLOC_CTX *)message, &message->SPropTagArray, PR_INTERNET_CPID);
+
+	obj_message->private_data = (void *) message;
+}
+
+
 /**
    \details Opens a specific message and retrieves a MAPI object that
    can be used to get or set message properties.
@@ -70,16 +128,11 @@ _PUBLIC_ enum MAPISTATUS OpenMessage(mapi_object_t *obj_store,
 	struct mapi_response		*mapi_response;
 	struct EcDoRpc_MAPI_REQ		*mapi_req;
 	struct OpenMessage_req		request;
-	struct OpenMessage_repl		*reply;
 	struct mapi_session		*session;
-	mapi_object_message_t		*message;
-	struct SPropValue		lpProp;
-	const char			*tstring;
 	NTSTATUS			status;
 	enum MAPISTATUS			retval;
 	uint32_t			size = 0;
 	TALLOC_CTX			*mem_ctx;
-	uint32_t			i = 0;
 	uint8_t				logon_id;
 
 	/* Sanity checks */
@@ -128,58 +181,102 @@ _PUBLIC_ enum MAPISTATUS OpenMessage(mapi_object_t *obj_store,
 
 	OPENCHANGE_CHECK_NOTIFICATION(session, mapi_response);
 
-	/* Set object session and handle */
-	mapi_object_set_session(obj_message, session);
-	mapi_object_set_handle(obj_message, mapi_response->handles[1]);
-	mapi_object_set_logon_id(obj_message, logon_id);
+	/* Set object session, handle and OpenMessage reply data */
+	OpenMessage_reply(obj_message, session, logon_id, mapi_response->handles[1],
+			  &mapi_response->mapi_repl->u.mapi_OpenMessage);
 
-	/* Store OpenMessage reply data */
-	reply = &mapi_response->mapi_repl->u.mapi_OpenMessage;
+	talloc_free(mapi_response);
+	talloc_free(mem_ctx);
 
-	message = talloc_zero((TALLOC_CTX *)session, mapi_object_message_t);
+	return MAPI_E_SUCCESS;
+}
 
-	tstring = get_TypedString(&reply->SubjectPrefix);
-	if (tstring) {
-		message->SubjectPrefix = talloc_strdup((TALLOC_CTX *)message, tstring);
-	}
 
-	tstring = get_TypedString(&reply->NormalizedSubject);
-	if (tstring) {
-		message->NormalizedSubject = talloc_strdup((TALLOC_CTX *)message, tstring);
-	}
-	
+struct OpenMessage_batch {
+	mapi_object_t			*obj_message;
+	uint8_t				logon_id;
+};
 
-	message->cValues = reply->RecipientColumns.cValues;
-	message->SRowSet.cRows = reply->RowCount;
-	message->SRowSet.aRow = talloc_array((TALLOC_CTX *)message, struct SRow, reply->RowCount + 1);
+static enum MAPISTATUS OpenMessage_batch_reply(struct mapi_batch *batch,
+					       struct EcDoRpc_MAPI_REPL *mapi_repl,
+					       uint32_t handle, void *private_data)
+{
+	struct OpenMessage_batch	*ctx = (struct OpenMessage_batch *) private_data;
 
-	message->SPropTagArray.cValues = reply->RecipientColumns.cValues;
-	message->SPropTagArray.aulPropTag = talloc_steal(message, reply->RecipientColumns.aulPropTag);
+	OpenMessage_reply(ctx->obj_message, mapi_batch_get_session(batch), ctx->logon_id,
+			  handle, &mapi_repl->u.mapi_OpenMessage);
 
-	for (i = 0; i < reply->RowCount; i++) {
-		emsmdb_get_SRow((TALLOC_CTX *)message,
-				&(message->SRowSet.aRow[i]), &message->SPropTagArray, 
-				reply->RecipientRows[i].RecipientRow.prop_count,
-				&reply->RecipientRows[i].RecipientRow.prop_values,
-				reply->RecipientRows[i].RecipientRow.layout, 1);
+	return MAPI_E_SUCCESS;
+}
 
-		lpProp.ulPropTag = PR_RECIPIENT_TYPE;
-		lpProp.value.l = reply->RecipientRows[i].RecipientType;
-		SRow_addprop(&(message->SRowSet.aRow[i]), lpProp);
 
-		lpProp.ulPropTag = PR_INTERNET_CPID;
-		lpProp.value.l = reply->RecipientRows[i].CodePageId;
-		SRow_addprop(&(message->SRowSet.aRow[i]), lpProp);
-	}
+/**
+   \details Queue the opening of a message in a batch
 
-	/* add SPropTagArray elements we automatically append to SRow */
-	SPropTagArray_add((TALLOC_CTX *)message, &message->SPropTagArray, PR_RECIPIENT_TYPE);
-	SPropTagArray_add((TALLOC_CTX *)message, &message->SPropTagArray, PR_INTERNET_CPID);
+   The message is opened when the batch is flushed, it can be used as
+   input by the calls queued after this one in the same batch.
 
-	obj_message->private_data = (void *) message;
+   \param batch pointer to the batch
+   \param obj_store the store to read from
+   \param id_folder the folder ID
+   \param id_message the message ID
+   \param obj_message the resulting message object
+   \param ulFlags the access mode, see OpenMessage
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
 
-	talloc_free(mapi_response);
-	talloc_free(mem_ctx);
+   \return MAPI_E_SUCCESS if the call was queued, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: obj_store does not belong to the batch
+     session
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the batch is full and must be
+     flushed first
+
+   \sa mapi_batch_begin, mapi_batch_flush, OpenMessage
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_OpenMessage(struct mapi_batch *batch,
+						mapi_object_t *obj_store,
+						mapi_id_t id_folder,
+						mapi_id_t id_message,
+						mapi_object_t *obj_message,
+						uint8_t ulFlags,
+						enum MAPISTATUS *status)
+{
+	struct EcDoRpc_MAPI_REQ		*mapi_req;
+	struct OpenMessage_batch	*ctx;
+	enum MAPISTATUS			retval;
+	uint8_t				logon_id;
+	uint8_t				output_idx;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch || !obj_store || !obj_message, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(mapi_object_get_session(obj_store) != mapi_batch_get_session(batch),
+			     MAPI_E_INVALID_PARAMETER, NULL);
+
+	if ((retval = mapi_object_get_logon_id(obj_store, &logon_id)) != MAPI_E_SUCCESS)
+		return retval;
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(NULL, struct EcDoRpc_MAPI_REQ);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	mapi_req->opnum = op_MAPI_OpenMessage;
+	mapi_req->logon_id = logon_id;
+	mapi_req->u.mapi_OpenMessage.CodePageId = 0xfff;
+	mapi_req->u.mapi_OpenMessage.FolderId = id_folder;
+	mapi_req->u.mapi_OpenMessage.OpenModeFlags = (enum OpenMessage_OpenModeFlags)ulFlags;
+	mapi_req->u.mapi_OpenMessage.MessageId = id_message;
+
+	ctx = talloc_zero(mapi_req, struct OpenMessage_batch);
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	ctx->obj_message = obj_message;
+	ctx->logon_id = logon_id;
+
+	retval = mapi_batch_queue(batch, obj_store, obj_message, mapi_req, OpenMessage_batch_reply,
+				  ctx, status, &output_idx);
+	OPENCHANGE_RETVAL_IF(retval, retval, mapi_req);
+	mapi_req->u.mapi_OpenMessage.handle_idx = output_idx;
 
 	return MAPI_E_SUCCESS;
 }
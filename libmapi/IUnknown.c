@@ -163,15 +163,97 @@ _PUBLIC_ enum MAPISTATUS Release(mapi_object_t *obj)
 }
 
 
+struct Release_batch {
+	mapi_object_t			*obj;
+};
+
+static enum MAPISTATUS Release_batch_reply(struct mapi_batch *batch,
+					   struct EcDoRpc_MAPI_REPL *mapi_repl,
+					   uint32_t handle, void *private_data)
+{
+	struct Release_batch	*ctx = (struct Release_batch *) private_data;
+
+	if (ctx->obj->private_data) {
+		talloc_free(ctx->obj->private_data);
+	}
+	mapi_object_init(ctx->obj);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the release of an object in a batch
+
+   The object is released on the server and reset, as
+   mapi_object_release does, when the batch is flushed. It may be an
+   object opened by a call queued earlier in the same batch. Stores
+   must be released with mapi_object_release.
+
+   \param batch pointer to the batch
+   \param obj the object to release
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
+
+   \return MAPI_E_SUCCESS if the call was queued, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: obj is a store or does not belong to
+     the batch session
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the batch is full and must be
+     flushed first
+
+   \sa mapi_batch_begin, mapi_batch_flush, Release
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_Release(struct mapi_batch *batch,
+					    mapi_object_t *obj,
+					    enum MAPISTATUS *status)
+{
+	struct EcDoRpc_MAPI_REQ	*mapi_req;
+	struct Release_batch	*ctx;
+	enum MAPISTATUS		retval;
+	uint8_t			logon_id;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch || !obj || obj->store, MAPI_E_INVALID_PARAMETER, NULL);
+
+	/* An object opened in the batch has no session until then */
+	if (mapi_batch_get_logon_id(batch, obj, &logon_id) != MAPI_E_SUCCESS) {
+		OPENCHANGE_RETVAL_IF(mapi_object_get_session(obj) != mapi_batch_get_session(batch),
+				     MAPI_E_INVALID_PARAMETER, NULL);
+		if ((retval = mapi_object_get_logon_id(obj, &logon_id)) != MAPI_E_SUCCESS)
+			return retval;
+	}
+
+	/* Fill the MAPI_REQ request */
+	mapi_req = talloc_zero(NULL, struct EcDoRpc_MAPI_REQ);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	mapi_req->opnum = op_MAPI_Release;
+	mapi_req->logon_id = logon_id;
+
+	ctx = talloc_zero(mapi_req, struct Release_batch);
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_NOT_ENOUGH_MEMORY, mapi_req);
+	ctx->obj = obj;
+
+	retval = mapi_batch_queue(batch, obj, NULL, mapi_req, Release_batch_reply, ctx, status, NULL);
+	OPENCHANGE_RETVAL_IF(retval, retval, mapi_req);
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Returns the latest error code.
 
    This function returns the error code set by a previous function
    call.
 
-   \note Calls to this function may not work reliably in multi-threaded or
-   multisession code. We suggest you capture the return value of the call,
-   and check that instead.
+   \note The error code is kept in errno, it is therefore per thread:
+   each thread gets the error of its own latest call, whichever
+   session it was made on. A thread working with several sessions
+   should still capture the return value of the call, and check that
+   instead.
 */
 _PUBLIC_ enum MAPISTATUS GetLastError(void)
 {
@@ -24,6 +24,9 @@
 #include "gen_ndr/ndr_asyncemsmdb.h"
 #include "gen_ndr/ndr_asyncemsmdb_c.h"
 
+#include <tevent.h>
+#include <util/tevent_ntstatus.h>
+
 /**
    \file async_emsmdb.c
 
@@ -69,3 +72,93 @@ enum MAPISTATUS emsmdb_async_waitex(struct emsmdb_context *emsmdb_ctx, uint32_t
 
 	return MAPI_E_SUCCESS;
 }
+
+
+struct emsmdb_async_waitex_state {
+	struct EcDoAsyncWaitEx	r;
+	uint32_t		flagsOut;
+};
+
+static void emsmdb_async_waitex_done(struct tevent_req *);
+
+/**
+   \details Create an asynchronous wait call without blocking
+
+   This is the non-blocking variant of emsmdb_async_waitex: the call
+   is parked on the AsyncEMSMDB interface and completes from the event
+   context the connection was opened with.
+
+   \param mem_ctx pointer to the memory context
+   \param ev the event context of the connection
+   \param emsmdb_ctx pointer to the EMSMDB context
+   \param flagsIn input flags (currently must be 0x00000000)
+
+   \return the request on success, otherwise NULL
+
+   \sa emsmdb_async_waitex_recv
+ */
+struct tevent_req *emsmdb_async_waitex_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
+					    struct emsmdb_context *emsmdb_ctx, uint32_t flagsIn)
+{
+	struct tevent_req			*req;
+	struct tevent_req			*subreq;
+	struct emsmdb_async_waitex_state	*state;
+
+	/* Sanity Checks */
+	if (!ev || !emsmdb_ctx || !emsmdb_ctx->async_rpc_connection) return NULL;
+
+	req = tevent_req_create(mem_ctx, &state, struct emsmdb_async_waitex_state);
+	if (!req) return NULL;
+
+	state->r.in.async_handle = &(emsmdb_ctx->async_handle);
+	state->r.in.ulFlagsIn = flagsIn;
+	state->r.out.pulFlagsOut = &state->flagsOut;
+	dcerpc_binding_handle_set_timeout(emsmdb_ctx->async_rpc_connection->binding_handle, 400);
+
+	subreq = dcerpc_EcDoAsyncWaitEx_r_send(state, ev, emsmdb_ctx->async_rpc_connection->binding_handle, &state->r);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, emsmdb_async_waitex_done, req);
+
+	return req;
+}
+
+static void emsmdb_async_waitex_done(struct tevent_req *subreq)
+{
+	struct tevent_req			*req = tevent_req_callback_data(subreq, struct tevent_req);
+	struct emsmdb_async_waitex_state	*state = tevent_req_data(req, struct emsmdb_async_waitex_state);
+	NTSTATUS				status;
+
+	status = dcerpc_EcDoAsyncWaitEx_r_recv(subreq, state);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+/**
+   \details Receive the result of an asynchronous wait call
+
+   \param req the request returned by emsmdb_async_waitex_send
+   \param flagsOut output flags (zero for a call completion with no changes, non-zero if there are changes)
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+enum MAPISTATUS emsmdb_async_waitex_recv(struct tevent_req *req, uint32_t *flagsOut)
+{
+	struct emsmdb_async_waitex_state	*state = tevent_req_data(req, struct emsmdb_async_waitex_state);
+	NTSTATUS				status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_IO_TIMEOUT), MAPI_E_TIMEOUT, NULL);
+		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_CONNECTION_DISCONNECTED), MAPI_E_END_OF_SESSION, NULL);
+		OPENCHANGE_RETVAL_IF(NT_STATUS_EQUAL(status, NT_STATUS_NO_MEMORY), MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+		OPENCHANGE_RETVAL_IF(!NT_STATUS_IS_OK(status), NT_STATUS_V(status), NULL);
+	}
+
+	*flagsOut = state->flagsOut;
+	return MAPI_E_SUCCESS;
+}
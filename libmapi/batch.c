@@ -0,0 +1,427 @@
+/*
+   OpenChange MAPI implementation.
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+
+/**
+   \file batch.c
+
+   \brief Send several ROPs in a single EMSMDB round-trip
+
+   A batch queues calls such as mapi_batch_OpenMessage or
+   mapi_batch_GetProps instead of sending them, and mapi_batch_flush
+   sends them together. An object opened by a queued call can be used
+   as input by the calls queued after it: the request refers to it by
+   its position in the handle array, which the server fills when the
+   object is opened.
+
+   The results of the queued calls are only available once the batch
+   has been flushed. Calls the server does not reply to, such as
+   mapi_batch_Release, are complete once the server processed a call
+   queued after them or ran out of calls.
+ */
+
+
+/* Handle indexes are uint8_t and 0xff is reserved */
+#define	MAPI_BATCH_MAX_HANDLES	0xff
+/* Keep the request under the rgbIn limit of EcDoRpc */
+#define	MAPI_BATCH_MAX_SIZE	0x7000
+
+struct mapi_batch_entry {
+	struct EcDoRpc_MAPI_REQ		*mapi_req;
+	uint32_t			size;
+	int				output_idx;
+	mapi_batch_reply_fn		reply_fn;
+	void				*private_data;
+	enum MAPISTATUS			*status;
+};
+
+struct mapi_batch_handle {
+	mapi_object_t			*obj;
+	bool				ready; /* false until the server opens the object */
+};
+
+struct mapi_batch {
+	struct mapi_session		*session;
+	struct mapi_batch_entry		*entries;
+	uint32_t			count;
+	uint32_t			size;
+	struct mapi_batch_handle	handles[MAPI_BATCH_MAX_HANDLES];
+	uint8_t				handle_count;
+};
+
+
+/**
+   \details Begin a batch of MAPI calls
+
+   \param mem_ctx pointer to the memory context
+   \param session pointer to the session the calls are sent to
+   \param batchp pointer on pointer to the batch to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: session or batchp is NULL
+   - MAPI_E_NOT_ENOUGH_MEMORY: the batch could not be allocated
+
+   \sa mapi_batch_flush
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_begin(TALLOC_CTX *mem_ctx,
+					  struct mapi_session *session,
+					  struct mapi_batch **batchp)
+{
+	struct mapi_batch	*batch;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!batchp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	batch = talloc_zero(mem_ctx, struct mapi_batch);
+	OPENCHANGE_RETVAL_IF(!batch, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	batch->session = session;
+
+	*batchp = batch;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Return the session of a batch
+
+   \param batch pointer to the batch
+
+   \return the session the batch is sent to
+ */
+struct mapi_session *mapi_batch_get_session(struct mapi_batch *batch)
+{
+	return batch ? batch->session : NULL;
+}
+
+
+static int mapi_batch_find_handle(struct mapi_batch *batch, mapi_object_t *obj)
+{
+	int	i;
+
+	/* The last object queued under this pointer wins */
+	for (i = batch->handle_count - 1; i >= 0; i--) {
+		if (batch->handles[i].obj == obj) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+static bool mapi_batch_has_reply(uint8_t opnum)
+{
+	return opnum != op_MAPI_Release;
+}
+
+
+/**
+   \details Return the handle index of an object in a batch
+
+   This is the index a ROP request refers to obj with, for the handles
+   a ROP uses besides its input and output ones. An object which is
+   not opened by a call queued in the batch is given a new index.
+
+   \param batch pointer to the batch
+   \param obj the object
+   \param handle_idx pointer to the handle index to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_ENOUGH_RESOURCES if
+   the handle array is full, in which case the batch must be flushed
+   first
+ */
+enum MAPISTATUS mapi_batch_get_handle_idx(struct mapi_batch *batch, mapi_object_t *obj, uint8_t *handle_idx)
+{
+	int	idx;
+
+	idx = mapi_batch_find_handle(batch, obj);
+	if (idx == -1) {
+		/* Keep room for the input and output handles of the ROP */
+		OPENCHANGE_RETVAL_IF(batch->handle_count + 3 > MAPI_BATCH_MAX_HANDLES,
+				     MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+		idx = batch->handle_count++;
+		batch->handles[idx].obj = obj;
+		batch->handles[idx].ready = true;
+	}
+	*handle_idx = idx;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Return the logon identifier of an object opened in a batch
+
+   \param batch pointer to the batch
+   \param obj the object
+   \param logon_id pointer to the logon identifier to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if obj is not
+   opened by a call queued in the batch
+ */
+enum MAPISTATUS mapi_batch_get_logon_id(struct mapi_batch *batch, mapi_object_t *obj, uint8_t *logon_id)
+{
+	uint32_t	i;
+	int		idx;
+
+	idx = mapi_batch_find_handle(batch, obj);
+	if (idx == -1 || batch->handles[idx].ready) {
+		return MAPI_E_NOT_FOUND;
+	}
+
+	for (i = 0; i < batch->count; i++) {
+		if (batch->entries[i].output_idx == idx) {
+			*logon_id = batch->entries[i].mapi_req->logon_id;
+			return MAPI_E_SUCCESS;
+		}
+	}
+
+	return MAPI_E_NOT_FOUND;
+}
+
+
+/**
+   \details Queue a ROP in a batch
+
+   The input handle index of the ROP is set here: an object opened by a
+   call queued earlier in the batch is referred to by the index of its
+   output handle, other objects are given a new index holding their
+   handle. The caller sets the output handle index of a ROP opening
+   obj_out to the one returned in output_idx.
+
+   \param batch pointer to the batch
+   \param obj_in the object the ROP applies to
+   \param obj_out the object the ROP opens, NULL if none
+   \param mapi_req pointer to the ROP request, the batch takes
+   ownership of it
+   \param reply_fn the function processing the ROP reply, called with
+   a NULL reply for ROPs the server does not reply to
+   \param private_data pointer passed to reply_fn, the batch takes
+   ownership of it
+   \param status pointer to the status of the call to set when the
+   batch is flushed, may be NULL
+   \param output_idx pointer to the output handle index to return,
+   may be NULL if obj_out is NULL
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_ENOUGH_RESOURCES if
+   the request or its handle array would be too large, in which case
+   the batch must be flushed first
+ */
+enum MAPISTATUS mapi_batch_queue(struct mapi_batch *batch, mapi_object_t *obj_in, mapi_object_t *obj_out,
+				 struct EcDoRpc_MAPI_REQ *mapi_req, mapi_batch_reply_fn reply_fn,
+				 void *private_data, enum MAPISTATUS *status, uint8_t *output_idx)
+{
+	struct ndr_push			*ndr;
+	struct mapi_batch_entry		*entries;
+	uint32_t			size;
+	int				input_idx;
+
+	/* The size of the ROP on the wire */
+	ndr = ndr_push_init_ctx(batch);
+	OPENCHANGE_RETVAL_IF(!ndr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	if (ndr_push_EcDoRpc_MAPI_REQ(ndr, NDR_SCALARS, mapi_req) != NDR_ERR_SUCCESS) {
+		talloc_free(ndr);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_INVALID_PARAMETER, NULL);
+	}
+	size = ndr->offset;
+	talloc_free(ndr);
+
+	input_idx = mapi_batch_find_handle(batch, obj_in);
+	OPENCHANGE_RETVAL_IF(batch->size + size > MAPI_BATCH_MAX_SIZE, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+	OPENCHANGE_RETVAL_IF(batch->handle_count + (input_idx == -1) + (obj_out != NULL) > MAPI_BATCH_MAX_HANDLES,
+			     MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+
+	entries = talloc_realloc(batch, batch->entries, struct mapi_batch_entry, batch->count + 1);
+	OPENCHANGE_RETVAL_IF(!entries, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	batch->entries = entries;
+
+	if (input_idx == -1) {
+		input_idx = batch->handle_count++;
+		batch->handles[input_idx].obj = obj_in;
+		batch->handles[input_idx].ready = true;
+	}
+	mapi_req->handle_idx = input_idx;
+
+	entries[batch->count].output_idx = -1;
+	if (obj_out) {
+		entries[batch->count].output_idx = batch->handle_count++;
+		batch->handles[entries[batch->count].output_idx].obj = obj_out;
+		batch->handles[entries[batch->count].output_idx].ready = false;
+		if (output_idx) {
+			*output_idx = entries[batch->count].output_idx;
+		}
+	}
+
+	entries[batch->count].mapi_req = talloc_steal(entries, mapi_req);
+	entries[batch->count].size = size;
+	entries[batch->count].reply_fn = reply_fn;
+	entries[batch->count].private_data = talloc_steal(entries, private_data);
+	entries[batch->count].status = status;
+	if (status) {
+		*status = MAPI_E_UNABLE_TO_COMPLETE;
+	}
+	batch->count++;
+	batch->size += size;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static void mapi_batch_reset(struct mapi_batch *batch)
+{
+	talloc_free(batch->entries);
+	batch->entries = NULL;
+	batch->count = 0;
+	batch->size = 0;
+	batch->handle_count = 0;
+}
+
+
+/**
+   \details Send the calls queued in a batch
+
+   The calls are sent in a single request. When the server runs out of
+   room for the replies, the calls it did not process are sent again
+   in another request. The status of each call is returned through the
+   pointer given when it was queued. The batch is empty and can be
+   reused once flushed.
+
+   \param batch pointer to the batch
+
+   \return MAPI_E_SUCCESS if the calls were sent, otherwise MAPI
+   error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: batch is NULL
+   - MAPI_E_CALL_FAILED: A network problem was encountered during the
+     transaction
+   - MAPI_E_NOT_ENOUGH_RESOURCES: the server could not process a call
+     on its own
+ */
+_PUBLIC_ enum MAPISTATUS mapi_batch_flush(struct mapi_batch *batch)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct mapi_request	*mapi_request;
+	struct mapi_response	*mapi_response;
+	struct EcDoRpc_MAPI_REPL *mapi_repl;
+	struct EcDoRpc_MAPI_REPL no_repl;
+	struct mapi_batch_entry	*entry;
+	NTSTATUS		status;
+	enum MAPISTATUS		retval = MAPI_E_SUCCESS;
+	uint32_t		start;
+	uint32_t		next;
+	uint32_t		size;
+	uint32_t		i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!batch, MAPI_E_INVALID_PARAMETER, NULL);
+
+	for (start = 0; start < batch->count; start = next) {
+		mem_ctx = talloc_named(batch, 0, "mapi_batch_flush");
+
+		/* Step 1. Build the request from the calls left */
+		mapi_request = talloc_zero(mem_ctx, struct mapi_request);
+		mapi_request->mapi_req = talloc_zero_array(mem_ctx, struct EcDoRpc_MAPI_REQ, batch->count - start + 1);
+		size = 0;
+		for (i = start; i < batch->count; i++) {
+			mapi_request->mapi_req[i - start] = *batch->entries[i].mapi_req;
+			size += batch->entries[i].size;
+		}
+		mapi_request->length = size + sizeof (uint16_t);
+		mapi_request->mapi_len = mapi_request->length + batch->handle_count * sizeof (uint32_t);
+		mapi_request->handles = talloc_array(mem_ctx, uint32_t, batch->handle_count);
+		for (i = 0; i < batch->handle_count; i++) {
+			mapi_request->handles[i] = batch->handles[i].ready ?
+				mapi_object_get_handle(batch->handles[i].obj) : 0xffffffff;
+		}
+
+		/* Step 2. Send it */
+		status = emsmdb_transaction_wrapper(batch->session, mem_ctx, mapi_request, &mapi_response);
+		if (!NT_STATUS_IS_OK(status) ||
+		    (!mapi_response->mapi_repl && mapi_batch_has_reply(batch->entries[start].mapi_req->opnum))) {
+			talloc_free(mem_ctx);
+			retval = MAPI_E_CALL_FAILED;
+			break;
+		}
+
+		/* Step 3. Dispatch the replies, in request order. Anything
+		   else, such as notifications, is skipped */
+		next = start;
+		memset(&no_repl, 0, sizeof (no_repl));
+		for (mapi_repl = mapi_response->mapi_repl ? mapi_response->mapi_repl : &no_repl; ; mapi_repl++) {
+			/* The server went past the calls without reply */
+			for (; next < batch->count && !mapi_batch_has_reply(batch->entries[next].mapi_req->opnum); next++) {
+				entry = &batch->entries[next];
+				retval = entry->reply_fn(batch, NULL, 0, entry->private_data);
+				if (entry->status) {
+					*entry->status = retval;
+				}
+			}
+			if (!mapi_repl->opnum || next >= batch->count) break;
+			if (mapi_repl->opnum == op_MAPI_BufferTooSmall) break;
+
+			entry = &batch->entries[next];
+			if (mapi_repl->opnum != entry->mapi_req->opnum) continue;
+			next++;
+
+			if (mapi_repl->error_code == MAPI_E_SUCCESS || mapi_repl->error_code == MAPI_W_ERRORS_RETURNED) {
+				retval = entry->reply_fn(batch, mapi_repl,
+							 (entry->output_idx >= 0) ? mapi_response->handles[entry->output_idx] : 0,
+							 entry->private_data);
+			} else {
+				retval = mapi_repl->error_code;
+			}
+			if (retval == MAPI_E_SUCCESS && entry->output_idx >= 0) {
+				batch->handles[entry->output_idx].ready = true;
+			}
+			if (entry->status) {
+				*entry->status = retval;
+			}
+		}
+		retval = MAPI_E_SUCCESS;
+
+		if (mapi_response->mapi_repl) {
+			OPENCHANGE_CHECK_NOTIFICATION(batch->session, mapi_response);
+		}
+		talloc_free(mapi_response);
+		talloc_free(mem_ctx);
+
+		/* A call whose reply does not fit on its own cannot be
+		   batched */
+		if (next == start) {
+			retval = MAPI_E_NOT_ENOUGH_RESOURCES;
+			break;
+		}
+	}
+
+	mapi_batch_reset(batch);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	return MAPI_E_SUCCESS;
+}
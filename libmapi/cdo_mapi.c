@@ -22,6 +22,7 @@
 #include "libmapi/libmapi_private.h"
 #include <param.h>
 #include <ldb.h>
+#include <tevent.h>
 
 /**
    \file cdo_mapi.c
@@ -239,12 +240,16 @@ _PUBLIC_ enum MAPISTATUS MAPIInitialize(struct mapi_context **_mapi_ctx, const c
 	mapi_ctx->dumpdata = false;
 	mapi_ctx->session = NULL;
 	mapi_ctx->lp_ctx = loadparm_init_global(true);
+	mapi_ctx->max_response_size = EMSMDB_EXT2_MIN_RESPONSE;
+	mapi_ctx->compression = true;
 
 	/* Enable logging on stdout */
 	oc_log_init_stdout();
 
 	/* profile store */
-	retval = OpenProfileStore(mapi_ctx, &mapi_ctx->ldb_ctx, profiledb);
+	mapi_ctx->profiledb = talloc_strdup(mapi_ctx, profiledb);
+	OPENCHANGE_RETVAL_IF(!mapi_ctx->profiledb, MAPI_E_NOT_ENOUGH_RESOURCES, mem_ctx);
+	retval = OpenProfileStore(mapi_ctx, &mapi_ctx->ldb_ctx, profiledb, false);
 	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
 
 	/* Initialize dcerpc subsystem */
@@ -283,6 +288,8 @@ _PUBLIC_ void MAPIUninitialize(struct mapi_context *mapi_ctx)
 		close(session->notify_ctx->fd);
 	}
 	
+	mapi_connection_pool_free(mapi_ctx);
+
 	mem_ctx = mapi_ctx->mem_ctx;
 	talloc_free(mem_ctx);
 	mapi_ctx = NULL;
@@ -341,6 +348,222 @@ _PUBLIC_ enum MAPISTATUS SetMAPIDebugLevel(struct mapi_context *mapi_ctx, uint32
 }
 
 
+/**
+   \details Set the maximum size of the responses sent by Exchange
+   2007 and later servers
+
+   \param mapi_ctx pointer to the MAPI context
+   \param size the maximum response size in bytes
+
+   Responses larger than the default 0x8007 bytes let the server chain
+   several extended buffers, so a bulk FXGetBuffer transfer returns up
+   to size bytes per round-trip.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_NOT_INITIALIZED: MAPI subsystem has not been initialized
+   - MAPI_E_INVALID_PARAMETER: size is lower than 0x8007 or greater
+     than 0x40000
+
+   \sa SetMAPICompression
+ */
+_PUBLIC_ enum MAPISTATUS SetMAPIResponseSize(struct mapi_context *mapi_ctx, uint32_t size)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(size < EMSMDB_EXT2_MIN_RESPONSE, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(size > EMSMDB_EXT2_MAX_RESPONSE, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_ctx->max_response_size = size;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Enable or disable compression of the requests and
+   responses exchanged with Exchange 2007 and later servers
+
+   \param mapi_ctx pointer to the MAPI context
+   \param status the status
+
+   possible status values/behavior:
+   -# true:  Requests are compressed and compressed responses are
+      accepted (default)
+   -# false: Requests are only obfuscated and the server is asked not
+      to compress its responses
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_INITIALIZED
+
+   \sa SetMAPIResponseSize
+ */
+_PUBLIC_ enum MAPISTATUS SetMAPICompression(struct mapi_context *mapi_ctx, bool status)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	mapi_ctx->compression = status;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Share connections between the sessions of a MAPI context
+
+   \param mapi_ctx pointer to the MAPI context
+   \param status the status
+   \param idle_timeout the number of seconds a connection no session
+   uses is kept open for another logon
+
+   possible status values/behavior:
+   -# true:  Sessions logging on to the same server with the same
+      credentials share one connection per interface (EMSMDB, NSPI and
+      the referral service). Each session still gets its own context
+      handle from EcDoConnectEx or NspiBind over it.
+   -# false: Each session opens its own connections (default)
+
+   This is meant for processes acting on behalf of many mailboxes with
+   one account, such as delegate access. Since the sessions of a
+   context share its connections, they must be used by one thread at
+   a time, as the context itself.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_INITIALIZED
+
+   \sa ReleaseIdleConnections
+ */
+_PUBLIC_ enum MAPISTATUS SetMAPIConnectionPool(struct mapi_context *mapi_ctx, bool status, uint32_t idle_timeout)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	mapi_ctx->connection_pool = status;
+	mapi_ctx->connection_idle_timeout = idle_timeout;
+
+	return ReleaseIdleConnections(mapi_ctx);
+}
+
+
+/**
+   \details Drive the connections of a MAPI context from one event
+   context
+
+   By default each connection runs its own event context, and the
+   calls on a connection block until it replies. With a shared event
+   context, the connections opened by the sessions logging on
+   afterwards are all driven by ev, so a single thread can wait on
+   the notifications of many sessions with
+   MonitorAsyncNotification() and LoopAsyncNotifications(), or from
+   its own tevent loop. Nesting is enabled on ev, since the blocking
+   calls of libmapi run it.
+
+   \param mapi_ctx pointer to the MAPI context
+   \param ev the event context to share, NULL for an event context
+   per connection (default)
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_INITIALIZED
+
+   \sa MonitorAsyncNotification, LoopAsyncNotifications
+ */
+_PUBLIC_ enum MAPISTATUS SetMAPIEventContext(struct mapi_context *mapi_ctx, struct tevent_context *ev)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	if (ev) {
+		tevent_loop_allow_nesting(ev);
+	}
+	mapi_ctx->ev = ev;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Keep the profiles read from the profile database and the
+   servers resolved at logon for a while
+
+   \param mapi_ctx pointer to the MAPI context
+   \param ttl the number of seconds the cached information is valid
+   for, 0 disables the cache (default)
+
+   With a cache, OpenProfile() reuses the profile records it read from
+   the database during the last ttl seconds instead of searching the
+   database again. Logon() also stores the NSPI server returned by
+   RfrGetNewDSA in the profile, and the encryption the server requires,
+   so the next logons within ttl seconds, from this process or
+   another one, connect straight to it.
+
+   Profiles modified through this context are dropped from its
+   cache. Changes made by other processes are seen once the cached
+   records expire.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_INITIALIZED
+
+   \sa SetMAPIProfileStoreReadOnly
+ */
+_PUBLIC_ enum MAPISTATUS SetMAPIProfileCacheTTL(struct mapi_context *mapi_ctx, uint32_t ttl)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	mapi_ctx->profile_cache_ttl = ttl;
+	if (!ttl) {
+		mapi_profile_cache_flush(mapi_ctx);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Open the profile database read-only
+
+   \param mapi_ctx pointer to the MAPI context
+   \param status the status
+
+   possible status values/behavior:
+   -# true:  The database is reopened read-only. It stays mapped in
+      memory and the profiles are read without taking write locks,
+      but any attempt to modify a profile fails
+   -# false: The database is reopened read-write (default)
+
+   Logon servers resolved with a cache enabled are not stored in a
+   read-only database.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_NOT_INITIALIZED: MAPI subsystem has not been initialized
+   - MAPI_E_NOT_FOUND: The profile database could not be opened
+
+   \sa SetMAPIProfileCacheTTL
+ */
+_PUBLIC_ enum MAPISTATUS SetMAPIProfileStoreReadOnly(struct mapi_context *mapi_ctx, bool status)
+{
+	enum MAPISTATUS		retval;
+	struct ldb_context	*ldb_ctx;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!mapi_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_ctx->ldb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	if (mapi_ctx->profiledb_readonly == status) return MAPI_E_SUCCESS;
+
+	retval = OpenProfileStore(mapi_ctx, &ldb_ctx, mapi_ctx->profiledb, status);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	talloc_free(mapi_ctx->ldb_ctx);
+	mapi_ctx->ldb_ctx = ldb_ctx;
+	mapi_ctx->profiledb_readonly = status;
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Retrieve the MAPI loadparm context for specified MAPI
    context
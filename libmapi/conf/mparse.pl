@@ -1277,6 +1277,93 @@ sub mapistore_namedprops_python($)
     return $ret;
 }
 
+#####################################################################
+# generate mapistore_namedprops_table.h file: the mappings of
+# mapistore_namedprops.ldif as tables compiled in libmapistore, sorted
+# for binary searches by name and by mapped property ID
+sub mapistore_namedprops_table($)
+{
+    my $contents = shift;
+    my $line;
+    my @lines;
+    my @prop;
+    my @entries;
+    my %seen;
+
+    @lines = split(/\n/, $contents);
+    foreach $line (@lines) {
+	$line =~ s/^\#+.*$//;
+	if ($line) {
+	    @prop = split(/\s+/, $line);
+	    next unless ($prop[7] && $oleguid{$prop[6]});
+	    my $entry = { guid => $oleguid{$prop[6]}, mapped_id => hex($prop[7]),
+			  prop_type => $prop[4], order => scalar(@entries) };
+	    if ($prop[5] eq "MNID_ID") {
+		$entry->{kind} = $MNID_ID;
+		$entry->{lid} = hex($prop[2]);
+		$entry->{name} = "";
+	    } elsif ($prop[5] eq "MNID_STRING") {
+		$entry->{kind} = $MNID_STRING;
+		$entry->{lid} = 0;
+		$entry->{name} = $prop[3];
+	    } else {
+		next;
+	    }
+	    # the LDB backend refuses a second record with the same DN
+	    my $key = join(",", $entry->{kind}, $entry->{guid}, $entry->{lid}, lc($entry->{name}));
+	    next if ($seen{$key});
+	    $seen{$key} = 1;
+	    push(@entries, $entry);
+	}
+    }
+
+    # same order as the comparison function of mapistore_namedprops.c
+    my @by_name = sort {
+	$a->{kind} <=> $b->{kind} || $a->{guid} cmp $b->{guid}
+	    || $a->{lid} <=> $b->{lid} || lc($a->{name}) cmp lc($b->{name})
+    } @entries;
+    my $i = 0;
+    foreach my $entry (@by_name) {
+	$entry->{index} = $i++;
+    }
+    # a mapped ID shared by several names resolves to the first one
+    my @by_id = sort {
+	$a->{mapped_id} <=> $b->{mapped_id} || $a->{order} <=> $b->{order}
+    } @entries;
+
+    mparse "/* header auto-generated by mparse */";
+    mparse "#ifndef __MAPISTORE_NAMEDPROPS_TABLE_H__";
+    mparse "#define __MAPISTORE_NAMEDPROPS_TABLE_H__";
+    mparse "";
+    mparse "static const struct mapistore_namedprops_default mapistore_namedprops_defaults[] = {";
+    indent;
+    foreach my $entry (@by_name) {
+	my @g = ($entry->{guid} =~ m/^(.{8})-(.{4})-(.{4})-(.{2})(.{2})-(.{2})(.{2})(.{2})(.{2})(.{2})(.{2})$/);
+	my $name = $entry->{name};
+	$name =~ s/([\\"])/\\$1/g;
+	mparse sprintf "{ %-12s { 0x%s, 0x%s, 0x%s, { 0x%s, 0x%s }, { 0x%s, 0x%s, 0x%s, 0x%s, 0x%s, 0x%s } }, 0x%.4x, %s, 0x%.4x, %s },",
+	    ($entry->{kind} == $MNID_ID) ? "MNID_ID," : "MNID_STRING,", @g, $entry->{lid},
+	    ($entry->{kind} == $MNID_ID) ? "NULL" : "\"$name\"", $entry->{mapped_id}, $entry->{prop_type};
+    }
+    deindent;
+    mparse "};";
+    mparse "";
+    mparse "static const uint16_t mapistore_namedprops_defaults_by_id[] = {";
+    indent;
+    my $last_id = -1;
+    foreach my $entry (@by_id) {
+	next if ($entry->{mapped_id} == $last_id);
+	$last_id = $entry->{mapped_id};
+	mparse sprintf "%d,", $entry->{index};
+    }
+    deindent;
+    mparse "};";
+    mparse "";
+    mparse "#endif /* !__MAPISTORE_NAMEDPROPS_TABLE_H__ */";
+
+    return $ret;
+}
+
 #####################################################################
 # generate mapistore_nameid.h file
 sub mapistore_nameid_header($)
@@ -1391,6 +1478,12 @@ sub process_file($)
         FileSave($mapistore_parser, mapistore_namedprops_python($contents));
     }
 
+    if ($opt_parser eq "mapistore_namedprops_table") {
+	print "Generating $outputdir" . "mapistore_namedprops_table.h\n";
+	my $mapistore_parser = ("$outputdir/mapistore_namedprops_table.h");
+	FileSave($mapistore_parser, mapistore_namedprops_table($contents));
+    }
+
     if ($opt_parser eq "mapistore_nameid") {
 	print "Generating $outputdir" . "mapistore_nameid.h\n";
 	my $mapistore_parser = ("$outputdir/mapistore_nameid.h");
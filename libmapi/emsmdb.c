@@ -148,6 +148,8 @@ struct emsmdb_context *emsmdb_connect(TALLOC_CTX *parent_mem_ctx,
 	ret->cred = cred;
 	ret->max_data = 0xFFF0;
 	ret->setup = false;
+	ret->max_response_size = EMSMDB_EXT2_MIN_RESPONSE;
+	ret->compression = true;
 
 	talloc_free(mem_ctx);
 
@@ -251,6 +253,8 @@ struct emsmdb_context *emsmdb_connect_ex(TALLOC_CTX *mem_ctx,
 	ctx->cred = cred;
 	ctx->max_data = 0xFFF0;
 	ctx->setup = false;
+	ctx->max_response_size = EMSMDB_EXT2_MIN_RESPONSE;
+	ctx->compression = true;
 
 	talloc_free(tmp_ctx);
 	return ctx;
@@ -434,8 +438,12 @@ start:
 		req->mapi_req = multi_req;
 	}
 
-	req->mapi_req = talloc_realloc(mem_ctx, req->mapi_req, struct EcDoRpc_MAPI_REQ, emsmdb_ctx->cache_count + 2);
-	req->mapi_req[i+1].opnum = 0;
+	/* Single ROP requests are not terminated, batches come with
+	   their terminator and must not be truncated */
+	if (emsmdb_ctx->cache_count || talloc_array_length(req->mapi_req) < 2) {
+		req->mapi_req = talloc_realloc(mem_ctx, req->mapi_req, struct EcDoRpc_MAPI_REQ, emsmdb_ctx->cache_count + 2);
+		req->mapi_req[i+1].opnum = 0;
+	}
 
 	r.in.mapi_request = req;
 	r.in.mapi_request->mapi_len += emsmdb_ctx->cache_size;
@@ -473,9 +481,123 @@ start:
 }
 
 
+/**
+   \details Append the reply of a chained extended buffer to the reply
+   of the ROP it repeats
+
+   \param mapi_response pointer to the response of the first extended
+   buffer
+   \param chained pointer to the response of a chained extended buffer
+
+   \return true if the reply was merged, otherwise false
+ */
+static bool emsmdb_merge_chained_response(struct mapi_response *mapi_response,
+					  struct mapi_response *chained)
+{
+	struct EcDoRpc_MAPI_REPL			*mapi_repl = NULL;
+	struct FastTransferSourceGetBuffer_repl		*reply;
+	struct FastTransferSourceGetBuffer_repl		*next;
+	uint8_t						*data;
+	uint32_t					i;
+
+	if (!mapi_response->mapi_repl || !chained->mapi_repl) return false;
+	if (chained->mapi_repl[0].opnum != op_MAPI_FastTransferSourceGetBuffer ||
+	    chained->mapi_repl[0].error_code != MAPI_E_SUCCESS) {
+		return false;
+	}
+
+	/* The repeated ROP is the last one of the first response */
+	for (i = 0; mapi_response->mapi_repl[i].opnum != 0; i++) {
+		if (mapi_response->mapi_repl[i].opnum == op_MAPI_FastTransferSourceGetBuffer) {
+			mapi_repl = &mapi_response->mapi_repl[i];
+		}
+	}
+	if (!mapi_repl || mapi_repl->error_code != MAPI_E_SUCCESS) return false;
+
+	reply = &mapi_repl->u.mapi_FastTransferSourceGetBuffer;
+	next = &chained->mapi_repl[0].u.mapi_FastTransferSourceGetBuffer;
+
+	data = talloc_array(mapi_response, uint8_t, reply->TransferBuffer.length + next->TransferBuffer.length);
+	if (!data) return false;
+	memcpy(data, reply->TransferBuffer.data, reply->TransferBuffer.length);
+	memcpy(data + reply->TransferBuffer.length, next->TransferBuffer.data, next->TransferBuffer.length);
+
+	reply->TransferBuffer.data = data;
+	reply->TransferBuffer.length += next->TransferBuffer.length;
+	/* The merged buffer may outgrow the 16 bits size, callers rely on
+	   the blob length */
+	reply->TransferBufferSize = MIN(reply->TransferBuffer.length, 0xFFFF);
+	reply->TransferStatus = next->TransferStatus;
+	reply->InProgressCount = next->InProgressCount;
+	reply->TotalStepCount = next->TotalStepCount;
+
+	return true;
+}
+
+
+/**
+   \details Pull the MAPI response from an EcDoRpcExt2 rgbOut buffer
+
+   The buffer holds one or more extended buffers, each one starting
+   with a RPC_HEADER_EXT header and holding a possibly compressed and
+   obfuscated MAPI response. The replies of chained extended buffers,
+   which repeat the last ROP of the request, are appended to the reply
+   of the first one.
+
+   \param mem_ctx pointer to the memory context
+   \param rgbOut pointer to the rgbOut buffer
+   \param repl pointer on pointer to the MAPI response to return
+
+   \return NT_STATUS_OK on success, otherwise NT status error
+ */
+_PUBLIC_ NTSTATUS emsmdb_pull_ext2_response(TALLOC_CTX *mem_ctx,
+					    DATA_BLOB *rgbOut,
+					    struct mapi_response **repl)
+{
+	struct ndr_pull		*ndr_pull;
+	struct mapi2k7_response	mapi2k7_response;
+	struct mapi_response	*mapi_response = NULL;
+	enum ndr_err_code	ndr_err;
+	uint32_t		chained = 0;
+
+	ndr_pull = ndr_pull_init_blob(rgbOut, mem_ctx);
+	if (!ndr_pull) return NT_STATUS_NO_MEMORY;
+	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+
+	do {
+		ndr_err = ndr_pull_mapi2k7_response(ndr_pull, NDR_SCALARS|NDR_BUFFERS, &mapi2k7_response);
+		if (ndr_err != NDR_ERR_SUCCESS) {
+			return ndr_map_error2ntstatus(ndr_err);
+		}
+
+		if (!mapi_response) {
+			mapi_response = mapi2k7_response.mapi_response;
+		} else if (emsmdb_merge_chained_response(mapi_response, mapi2k7_response.mapi_response)) {
+			chained++;
+		} else {
+			OC_DEBUG(1, "Unexpected chained extended buffer dropped");
+		}
+	} while (!(mapi2k7_response.header.Flags & RHEF_Last) && ndr_pull->offset < ndr_pull->data_size);
+
+	if (chained) {
+		OC_DEBUG(5, "EcDoRpcExt2 response merged %u chained extended buffers", chained);
+	}
+
+	*repl = mapi_response;
+
+	return NT_STATUS_OK;
+}
+
+
 /**
    \details Make a EMSMDB EXT2 transaction.
 
+   The request is compressed unless compression was disabled, which
+   lets the server compress its response too. When the request ends
+   with a FastTransferSourceGetBuffer ROP and the maximum response size
+   allows it, the server is asked to chain extended buffers so a
+   single call returns several transfer buffers.
+
    \param emsmdb_ctx pointer to the EMSMDB connection context
    \param mem_ctx pointer to the memory context
    \param req pointer to the MAPI request to send
@@ -491,70 +613,73 @@ _PUBLIC_ NTSTATUS emsmdb_transaction_ext2(struct emsmdb_context *emsmdb_ctx,
 {
 	NTSTATUS		status;
 	struct EcDoRpcExt2	r;
-	struct mapi2k7_response	mapi2k7_response;
 	struct ndr_push		*ndr_uncomp_rgbIn;
-	struct ndr_push		*ndr_comp_rgbIn;
+	struct ndr_push		*ndr_comp_rgbIn = NULL;
 	struct ndr_push		*ndr_rgbIn;
-	struct ndr_pull		*ndr_pull = NULL;
 	uint32_t		pulFlags = 0x0;
-	uint32_t		pcbOut = 0x8007;
+	uint32_t		pcbOut;
 	uint32_t		pcbAuxOut = 0x1008;
 	uint32_t		pulTransTime = 0;
+	uint32_t		i;
 	DATA_BLOB		rgbOut;
 	struct RPC_HEADER_EXT	RPC_HEADER_EXT;
-	enum ndr_err_code ndr_err;
 
 	r.in.handle = r.out.handle = &emsmdb_ctx->handle;
 	r.in.pulFlags = r.out.pulFlags = &pulFlags;
 
+	pcbOut = emsmdb_ctx->max_response_size;
+	if (pcbOut < EMSMDB_EXT2_MIN_RESPONSE || pcbOut > EMSMDB_EXT2_MAX_RESPONSE) {
+		pcbOut = EMSMDB_EXT2_MIN_RESPONSE;
+	}
+
+	/* Only FastTransferSourceGetBuffer callers handle more data than
+	   they asked for, other ROPs are never chained */
+	if (pcbOut > EMSMDB_EXT2_MIN_RESPONSE && req->mapi_req) {
+		/* Requests are not always terminated by an empty ROP */
+		i = talloc_array_length(req->mapi_req);
+		if (i > 1 && req->mapi_req[i - 1].opnum == 0) {
+			i--;
+		}
+		if (i && req->mapi_req[i - 1].opnum == op_MAPI_FastTransferSourceGetBuffer) {
+			pulFlags |= pulFlags_Chain;
+		}
+	}
+	if (!emsmdb_ctx->compression) {
+		pulFlags |= pulFlags_NoCompression;
+	}
+
 	/* Step 1. Push mapi_request in a data blob */
 	ndr_uncomp_rgbIn = ndr_push_init_ctx(mem_ctx);
 	ndr_set_flags(&ndr_uncomp_rgbIn->flags, LIBNDR_FLAG_NOALIGN);
 	ndr_push_mapi_request(ndr_uncomp_rgbIn, NDR_SCALARS|NDR_BUFFERS, req);
 
-	/* Step 2. Compress the blob */
-	/* 	ndr_comp_rgbIn = ndr_push_init_ctx(mem_ctx); */
-	/* 	ndr_push_lzxpress_compress(ndr_comp_rgbIn, ndr_uncomp_rgbIn); */
+	/* Step 2. Compress the blob, the server only compresses responses
+	   to compressed requests so this is done even when the compressed
+	   request is not smaller */
+	if (emsmdb_ctx->compression) {
+		ndr_comp_rgbIn = ndr_push_init_ctx(mem_ctx);
+		ndr_set_flags(&ndr_comp_rgbIn->flags, LIBNDR_FLAG_NOALIGN);
+		if (ndr_push_lzxpress_compress(ndr_comp_rgbIn, ndr_uncomp_rgbIn) != NDR_ERR_SUCCESS) {
+			talloc_free(ndr_comp_rgbIn);
+			ndr_comp_rgbIn = NULL;
+		}
+	}
 
-	/* If the compressed blob is larger than the uncompressed one, use obfuscation */
-	/* 	if (ndr_comp_rgbIn->offset > ndr_uncomp_rgbIn->offset) { */
-	/* 		talloc_free(ndr_comp_rgbIn); */
-	ndr_comp_rgbIn = ndr_uncomp_rgbIn;
-	obfuscate_data(ndr_comp_rgbIn->data, ndr_comp_rgbIn->offset, 0xA5);
-		
 	RPC_HEADER_EXT.Version = 0x0000;
-	RPC_HEADER_EXT.Flags = RHEF_XorMagic|RHEF_Last;
+	RPC_HEADER_EXT.SizeActual = ndr_uncomp_rgbIn->offset;
+	if (ndr_comp_rgbIn) {
+		RPC_HEADER_EXT.Flags = RHEF_Compressed|RHEF_XorMagic|RHEF_Last;
+	} else {
+		ndr_comp_rgbIn = ndr_uncomp_rgbIn;
+		RPC_HEADER_EXT.Flags = RHEF_XorMagic|RHEF_Last;
+	}
 	RPC_HEADER_EXT.Size = ndr_comp_rgbIn->offset;
-	RPC_HEADER_EXT.SizeActual = ndr_comp_rgbIn->offset;
+	obfuscate_data(ndr_comp_rgbIn->data, ndr_comp_rgbIn->offset, 0xA5);
 
 	ndr_rgbIn = ndr_push_init_ctx(mem_ctx);
 	ndr_set_flags(&ndr_rgbIn->flags, LIBNDR_FLAG_NOALIGN);
 	ndr_push_RPC_HEADER_EXT(ndr_rgbIn, NDR_SCALARS|NDR_BUFFERS, &RPC_HEADER_EXT);
 	ndr_push_bytes(ndr_rgbIn, ndr_comp_rgbIn->data, ndr_comp_rgbIn->offset);
-		/* 	} else { */
-		/* 		RPC_HEADER_EXT.Version = 0x0000; */
-		/* 		RPC_HEADER_EXT.Flags = RHEF_Compressed|RHEF_Last; */
-		/* 		RPC_HEADER_EXT.Size = ndr_comp_rgbIn->offset; */
-		/* 		RPC_HEADER_EXT.SizeActual = ndr_uncomp_rgbIn->offset; */
-
-		/* 		ndr_rgbIn = ndr_push_init_ctx(mem_ctx); */
-		/* 		ndr_set_flags(&ndr_rgbIn->flags, LIBNDR_FLAG_NOALIGN); */
-		/* 		ndr_push_RPC_HEADER_EXT(ndr_rgbIn, NDR_SCALARS|NDR_BUFFERS, &RPC_HEADER_EXT); */
-		/* 		ndr_push_bytes(ndr_rgbIn, ndr_comp_rgbIn->data, ndr_comp_rgbIn->offset); */
-		/* 	} */
-
-		/* Plain request (no obfuscation or compression) */
-		/* ndr_comp_rgbIn = ndr_uncomp_rgbIn; */
-		/* RPC_HEADER_EXT.Version = 0x0000; */
-		/* RPC_HEADER_EXT.Flags = RHEF_Last; */
-		/* RPC_HEADER_EXT.Size = ndr_uncomp_rgbIn->offset; */
-		/* RPC_HEADER_EXT.SizeActual = ndr_uncomp_rgbIn->offset; */
-
-		/* Pull the complete rgbIn */
-		/* ndr_rgbIn = ndr_push_init_ctx(mem_ctx); */
-		/* ndr_set_flags(&ndr_rgbIn->flags, LIBNDR_FLAG_NOALIGN); */
-		/* ndr_push_RPC_HEADER_EXT(ndr_rgbIn, NDR_SCALARS|NDR_BUFFERS, &RPC_HEADER_EXT); */
-		/* ndr_push_bytes(ndr_rgbIn, ndr_comp_rgbIn->data, ndr_comp_rgbIn->offset); */
 
 	r.in.rgbIn = ndr_rgbIn->data;
 	r.in.cbIn = ndr_rgbIn->offset;
@@ -569,7 +694,10 @@ _PUBLIC_ NTSTATUS emsmdb_transaction_ext2(struct emsmdb_context *emsmdb_ctx,
 
 	status = dcerpc_EcDoRpcExt2_r(emsmdb_ctx->rpc_connection->binding_handle, mem_ctx, &r);
 	talloc_free(ndr_rgbIn);
-	talloc_free(ndr_comp_rgbIn);
+	if (ndr_comp_rgbIn != ndr_uncomp_rgbIn) {
+		talloc_free(ndr_comp_rgbIn);
+	}
+	talloc_free(ndr_uncomp_rgbIn);
 
 	if (!NT_STATUS_IS_OK(status)) {
 		return status;
@@ -580,36 +708,64 @@ _PUBLIC_ NTSTATUS emsmdb_transaction_ext2(struct emsmdb_context *emsmdb_ctx,
 	/* Pull MAPI response form rgbOut */
 	rgbOut.data = r.out.rgbOut;
 	rgbOut.length = *r.out.pcbOut;
-	ndr_pull = ndr_pull_init_blob(&rgbOut, mem_ctx);
-	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
 
-	ndr_err = ndr_pull_mapi2k7_response(ndr_pull, NDR_SCALARS|NDR_BUFFERS, &mapi2k7_response);
-	if (ndr_err != NDR_ERR_SUCCESS) {
-		return ndr_map_error2ntstatus(ndr_err);
-	}
+	return emsmdb_pull_ext2_response(mem_ctx, &rgbOut, repl);
+}
 
-	*repl = mapi2k7_response.mapi_response;
 
-	return status;
-}
+/**
+   \details Send a MAPI request on the session connection and wait for
+   its response
 
+   A session belongs to one thread at a time. Two threads sending
+   requests on the same session at once would interleave their
+   handles and responses: the second one is refused instead.
 
+   \param session pointer to the MAPI session
+   \param mem_ctx pointer to the memory context
+   \param req pointer to the MAPI request
+   \param repl pointer on pointer to the MAPI response
+
+   \return NT_STATUS_OK on success, NT_STATUS_POSSIBLE_DEADLOCK if
+   another thread is using the session, otherwise an NT error
+ */
 _PUBLIC_ NTSTATUS emsmdb_transaction_wrapper(struct mapi_session *session,
 					     TALLOC_CTX *mem_ctx,
 					     struct mapi_request *req,
 					     struct mapi_response **repl)
 {
+	struct emsmdb_context	*emsmdb_ctx;
+	NTSTATUS		status;
+
 	if (session->emsmdb->ctx == NULL) return NT_STATUS_INVALID_PARAMETER;
+	emsmdb_ctx = (struct emsmdb_context *)session->emsmdb->ctx;
+
+	if (__sync_lock_test_and_set(&session->busy, 1)) {
+		OC_DEBUG(0, "session used by several threads at once");
+		return NT_STATUS_POSSIBLE_DEADLOCK;
+	}
+
 	switch (session->profile->exchange_version) {
 	case 0x0:
-	  return emsmdb_transaction((struct emsmdb_context *)session->emsmdb->ctx, mem_ctx, req, repl);
+		status = emsmdb_transaction(emsmdb_ctx, mem_ctx, req, repl);
+		break;
 	case 0x1:
 	case 0x2:
-	  return emsmdb_transaction_ext2((struct emsmdb_context *)session->emsmdb->ctx, mem_ctx, req, repl);
+		/* The tuning knobs may have changed since the connection */
+		if (session->mapi_ctx) {
+			emsmdb_ctx->max_response_size = session->mapi_ctx->max_response_size;
+			emsmdb_ctx->compression = session->mapi_ctx->compression;
+		}
+		status = emsmdb_transaction_ext2(emsmdb_ctx, mem_ctx, req, repl);
+		break;
+	default:
+		status = NT_STATUS_OK;
 		break;
 	}
 
-	return NT_STATUS_OK;
+	__sync_lock_release(&session->busy);
+
+	return status;
 }
 
 
@@ -1014,84 +1170,286 @@ enum MAPISTATUS emsmdb_get_SPropValue(TALLOC_CTX *mem_ctx,
 }
 
 
+/* How the values of a column are decoded */
+enum emsmdb_pull_kind {
+	EMSMDB_PULL_I2,
+	EMSMDB_PULL_LONG,
+	EMSMDB_PULL_BOOLEAN,
+	EMSMDB_PULL_I8,
+	EMSMDB_PULL_DOUBLE,
+	EMSMDB_PULL_SYSTIME,
+	EMSMDB_PULL_STRING8,
+	EMSMDB_PULL_UNICODE,
+	EMSMDB_PULL_BINARY,
+	EMSMDB_PULL_GENERIC
+};
+
+struct emsmdb_column_plan {
+	enum MAPITAGS		ulPropTag;
+	enum emsmdb_pull_kind	kind;
+};
+
+
 /**
-   \details Get a SPropValue array from a DATA blob
+   \details Build the decode plan of a column set
+
+   The property type of each column is looked at once, and the values
+   of the common types are then decoded in place, without going
+   through pull_emsmdb_property for each row.
 
    \param mem_ctx pointer to the memory context
-   \param content pointer to the DATA blob content
-   \param tags pointer to a list of property tags to lookup
-   \param propvals pointer on pointer to the returned SPropValues
-   \param cn_propvals pointer to the number of propvals
-   \param _offset the offset to return
+   \param proptags the columns of the rows
 
-   \return MAPI_E_SUCCESS on success
+   \return the decode plan on success, otherwise NULL
  */
-enum MAPISTATUS emsmdb_get_SPropValue_offset(TALLOC_CTX *mem_ctx,
-					     DATA_BLOB *content,
-					     struct SPropTagArray *tags,
-					     struct SPropValue **propvals,
-					     uint32_t *cn_propvals,
-					     uint32_t *_offset)
+static struct emsmdb_column_plan *emsmdb_column_plan_init(TALLOC_CTX *mem_ctx, struct SPropTagArray *proptags)
 {
-	struct SPropValue	*lpProps;
-	uint32_t		i_propval;
-	uint32_t		i_tag;
-	int			proptag;
-	uint32_t		cn_tags;
-	uint32_t		offset = *_offset;
+	struct emsmdb_column_plan	*plan;
+	uint32_t			i;
+
+	plan = talloc_array(mem_ctx, struct emsmdb_column_plan, proptags->cValues);
+	if (!plan) return NULL;
+
+	for (i = 0; i < proptags->cValues; i++) {
+		plan[i].ulPropTag = proptags->aulPropTag[i];
+		switch (proptags->aulPropTag[i] & 0xFFFF) {
+		case PT_I2:
+			plan[i].kind = EMSMDB_PULL_I2;
+			break;
+		case PT_ERROR:
+		case PT_LONG:
+			plan[i].kind = EMSMDB_PULL_LONG;
+			break;
+		case PT_BOOLEAN:
+			plan[i].kind = EMSMDB_PULL_BOOLEAN;
+			break;
+		case PT_I8:
+			plan[i].kind = EMSMDB_PULL_I8;
+			break;
+		case PT_DOUBLE:
+			plan[i].kind = EMSMDB_PULL_DOUBLE;
+			break;
+		case PT_SYSTIME:
+			plan[i].kind = EMSMDB_PULL_SYSTIME;
+			break;
+		case PT_STRING8:
+			plan[i].kind = EMSMDB_PULL_STRING8;
+			break;
+		case PT_UNICODE:
+			plan[i].kind = EMSMDB_PULL_UNICODE;
+			break;
+		case PT_SVREID:
+		case PT_BINARY:
+			plan[i].kind = EMSMDB_PULL_BINARY;
+			break;
+		default:
+			plan[i].kind = EMSMDB_PULL_GENERIC;
+			break;
+		}
+	}
+
+	return plan;
+}
+
+
+/**
+   \details Decode a property value in place
+
+   Strings and binary values are allocated on the current memory
+   context of the ndr_pull context. Values that can't be decoded are
+   returned as MAPI_E_NOT_FOUND errors, as pull_emsmdb_property does.
+
+   \param ndr the pull context positioned on the value
+   \param kind how to decode the value
+   \param lpProp the property value, which tag is already set
+   \param content the DATA blob being decoded
+ */
+static void emsmdb_pull_column(struct ndr_pull *ndr, enum emsmdb_pull_kind kind,
+			       struct SPropValue *lpProp, DATA_BLOB *content)
+{
+	enum ndr_err_code	ndr_err = NDR_ERR_SUCCESS;
+	uint32_t		offset;
+	uint64_t		ft;
+	uint16_t		cb;
+	const char		*str = NULL;
 	const void		*data;
+
+	switch (kind) {
+	case EMSMDB_PULL_I2:
+		lpProp->value.i = 0;
+		ndr_pull_uint16(ndr, NDR_SCALARS, &lpProp->value.i);
+		return;
+	case EMSMDB_PULL_LONG:
+		lpProp->value.l = 0;
+		ndr_pull_uint32(ndr, NDR_SCALARS, &lpProp->value.l);
+		return;
+	case EMSMDB_PULL_BOOLEAN:
+		lpProp->value.b = 0;
+		ndr_pull_uint8(ndr, NDR_SCALARS, &lpProp->value.b);
+		return;
+	case EMSMDB_PULL_I8:
+		lpProp->value.d = 0;
+		ndr_pull_dlong(ndr, NDR_SCALARS, &lpProp->value.d);
+		return;
+	case EMSMDB_PULL_DOUBLE:
+		lpProp->value.dbl = 0;
+		ndr_pull_double(ndr, NDR_SCALARS, &lpProp->value.dbl);
+		return;
+	case EMSMDB_PULL_SYSTIME:
+		ft = 0;
+		ndr_pull_hyper(ndr, NDR_SCALARS, &ft);
+		lpProp->value.ft.dwLowDateTime = ft & 0xFFFFFFFF;
+		lpProp->value.ft.dwHighDateTime = ft >> 32;
+		return;
+	case EMSMDB_PULL_STRING8:
+	case EMSMDB_PULL_UNICODE:
+		ndr_set_flags(&ndr->flags, (kind == EMSMDB_PULL_STRING8) ?
+			      LIBNDR_FLAG_STR_RAW8|LIBNDR_FLAG_STR_NULLTERM : LIBNDR_FLAG_STR_NULLTERM);
+		ndr_err = ndr_pull_string(ndr, NDR_SCALARS, &str);
+		ndr->flags &= ~(LIBNDR_FLAG_STR_RAW8|LIBNDR_FLAG_STR_NULLTERM);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err) || !str) break;
+		if (kind == EMSMDB_PULL_STRING8) {
+			lpProp->value.lpszA = str;
+		} else {
+			lpProp->value.lpszW = str;
+		}
+		return;
+	case EMSMDB_PULL_BINARY:
+		ndr_err = ndr_pull_uint16(ndr, NDR_SCALARS, &cb);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err) || cb > ndr->data_size - ndr->offset) break;
+		lpProp->value.bin.cb = cb;
+		lpProp->value.bin.lpb = (uint8_t *)talloc_memdup(ndr->current_mem_ctx, ndr->data + ndr->offset, cb);
+		ndr->offset += cb;
+		return;
+	case EMSMDB_PULL_GENERIC:
+		offset = ndr->offset;
+		data = pull_emsmdb_property(ndr->current_mem_ctx, &offset, lpProp->ulPropTag, content);
+		ndr->offset = offset;
+		set_SPropValue(lpProp, data);
+		free_emsmdb_property(lpProp, (void *) data);
+		return;
+	}
+
+	lpProp->ulPropTag = (enum MAPITAGS) ((lpProp->ulPropTag & 0xFFFF0000) | PT_ERROR);
+	lpProp->value.err = MAPI_E_NOT_FOUND;
+}
+
+
+/**
+   \details Decode a PropertyRow following a decode plan
+
+   Values flagged as missing are returned as MAPI_E_NOT_FOUND errors.
+
+   \param mem_ctx pointer to the memory context
+   \param ndr the pull context positioned on the row
+   \param plan the decode plan of the columns
+   \param cColumns the number of columns
+   \param content the DATA blob being decoded
+   \param cn_values pointer to the number of values present in the
+   row, may be NULL
+
+   \return the values of the row on success, otherwise NULL
+ */
+static struct SPropValue *emsmdb_pull_row(TALLOC_CTX *mem_ctx, struct ndr_pull *ndr,
+					  const struct emsmdb_column_plan *plan, uint32_t cColumns,
+					  DATA_BLOB *content, uint32_t *cn_values)
+{
+	struct SPropValue	*lpProps;
+	enum emsmdb_pull_kind	kind;
+	uint32_t		prop;
+	uint32_t		count = 0;
 	bool			is_FlaggedPropertyRow = false;
-	bool			havePropertyValue;
 	uint8_t			flag;
 
-	i_propval = 0;
-	cn_tags = tags->cValues;
-	*cn_propvals = 0;
-
-	if (0x1 == *(content->data + offset)) {
-		is_FlaggedPropertyRow = true;
-	} else {
-		is_FlaggedPropertyRow = false;
+	if (ndr->offset < ndr->data_size) {
+		is_FlaggedPropertyRow = (ndr->data[ndr->offset] == 0x1);
+		ndr->offset++;
 	}
-	++offset;
 
-	lpProps = talloc_array(mem_ctx, struct SPropValue, cn_tags);
-	for (i_tag = 0; i_tag < cn_tags; i_tag++) {
-		havePropertyValue = true;
-		lpProps[i_tag].ulPropTag = tags->aulPropTag[i_tag];
+	lpProps = talloc_array(mem_ctx, struct SPropValue, cColumns);
+	if (!lpProps) return NULL;
+	ndr->current_mem_ctx = lpProps;
+
+	for (prop = 0; prop < cColumns; prop++) {
+		lpProps[prop].ulPropTag = plan[prop].ulPropTag;
+		lpProps[prop].dwAlignPad = 0x0;
+		kind = plan[prop].kind;
+
 		if (is_FlaggedPropertyRow) {
-			flag = (uint8_t)(*(content->data + offset));
-			++offset;
+			flag = (ndr->offset < ndr->data_size) ? ndr->data[ndr->offset] : 0x1;
+			ndr->offset++;
 			switch (flag) {
 			case 0x0:
-				break;
-			case 0x1:
-				havePropertyValue = false;
+				/* Property Value is valid */
 				break;
 			case PT_ERROR:
-				proptag = (int)tags->aulPropTag[i_tag];
-				proptag &= 0xFFFF0000;
-				proptag |= PT_ERROR;
-				lpProps[i_tag].ulPropTag = (enum MAPITAGS) proptag;
+				lpProps[prop].ulPropTag = (enum MAPITAGS) ((plan[prop].ulPropTag & 0xFFFF0000) | PT_ERROR);
+				kind = EMSMDB_PULL_LONG;
 				break;
+			case 0x1:
+				/* Property Value is not present */
+				lpProps[prop].ulPropTag = (enum MAPITAGS) ((plan[prop].ulPropTag & 0xFFFF0000) | PT_ERROR);
+				lpProps[prop].value.err = MAPI_E_NOT_FOUND;
+				continue;
 			default:
+				/* unknown FlaggedPropertyValue flag */
 				break;
 			}
 		}
 
-		if (havePropertyValue) {
-			lpProps[i_tag].dwAlignPad = 0x0;
-			data = pull_emsmdb_property(mem_ctx, &offset, lpProps[i_tag].ulPropTag, content);
-			talloc_steal(lpProps, data);
-			set_SPropValue(&lpProps[i_tag], data);
-			free_emsmdb_property(&lpProps[i_tag], (void *)data);
-			i_propval++;
-		}
+		emsmdb_pull_column(ndr, kind, &lpProps[prop], content);
+		count++;
+	}
+
+	if (cn_values) {
+		*cn_values = count;
 	}
 
+	return lpProps;
+}
+
+
+/**
+   \details Get a SPropValue array from a DATA blob
+
+   \param mem_ctx pointer to the memory context
+   \param content pointer to the DATA blob content
+   \param tags pointer to a list of property tags to lookup
+   \param propvals pointer on pointer to the returned SPropValues
+   \param cn_propvals pointer to the number of propvals
+   \param _offset the offset to return
+
+   \return MAPI_E_SUCCESS on success
+ */
+enum MAPISTATUS emsmdb_get_SPropValue_offset(TALLOC_CTX *mem_ctx,
+					     DATA_BLOB *content,
+					     struct SPropTagArray *tags,
+					     struct SPropValue **propvals,
+					     uint32_t *cn_propvals,
+					     uint32_t *_offset)
+{
+	struct emsmdb_column_plan	*plan;
+	struct ndr_pull			*ndr;
+	struct SPropValue		*lpProps;
+
+	*cn_propvals = 0;
+
+	plan = emsmdb_column_plan_init(mem_ctx, tags);
+	OPENCHANGE_RETVAL_IF(!plan, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	ndr = talloc_zero(plan, struct ndr_pull);
+	OPENCHANGE_RETVAL_IF(!ndr, MAPI_E_NOT_ENOUGH_MEMORY, plan);
+	ndr->offset = *_offset;
+	ndr->data = content->data;
+	ndr->data_size = content->length;
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+
+	lpProps = emsmdb_pull_row(mem_ctx, ndr, plan, tags->cValues, content, cn_propvals);
+	OPENCHANGE_RETVAL_IF(!lpProps, MAPI_E_NOT_ENOUGH_MEMORY, plan);
+
 	*propvals = lpProps;
-	*cn_propvals = i_propval;
-	*_offset = offset;
+	*_offset = ndr->offset;
+	talloc_free(plan);
+
 	return MAPI_E_SUCCESS;
 }
 
@@ -1099,6 +1457,9 @@ enum MAPISTATUS emsmdb_get_SPropValue_offset(TALLOC_CTX *mem_ctx,
 /**
    \details Get a SRowSet from a DATA blob
 
+   The columns are looked at once for the whole set: the rows are then
+   decoded in a single pass over the blob.
+
    \param mem_ctx pointer on the memory context
    \param rowset pointer on the returned SRowSe
    \param proptags pointer on a list of property tags to lookup
@@ -1114,71 +1475,34 @@ _PUBLIC_ void emsmdb_get_SRowSet(TALLOC_CTX *mem_ctx,
 				 struct SPropTagArray *proptags, 
 				 DATA_BLOB *content)
 {
-	struct SRow		*rows;
-	struct SPropValue	*lpProps;
-	int			proptag;
-	uint32_t		idx;
-	uint32_t		prop;
-	uint32_t		offset = 0;
-	const void		*data;
-	uint32_t		row_count;
-	bool			is_FlaggedPropertyRow = false;
-	bool			havePropertyValue;
-	uint8_t			flag;
+	struct emsmdb_column_plan	*plan;
+	struct ndr_pull			*ndr;
+	struct SRow			*rows;
+	uint32_t			idx;
+	uint32_t			row_count;
 
 	/* caller allocated */
 	rows = rowset->aRow;
 	row_count = rowset->cRows;
 
-	for (idx = 0; idx < row_count; idx++) {
-		if (0x1 == *(content->data + offset)) {
-			is_FlaggedPropertyRow = true;
-		} else {
-			is_FlaggedPropertyRow = false;
-		}
-		++offset;
-
-		lpProps = talloc_array(mem_ctx, struct SPropValue, proptags->cValues);
-		for (prop = 0; prop < proptags->cValues; prop++) {
-			havePropertyValue = true;
-			lpProps[prop].ulPropTag = proptags->aulPropTag[prop];
-			if (is_FlaggedPropertyRow) {
-				flag = (uint8_t)(*(content->data + offset));
-				++offset; /* advance offset for the flag */
-				switch (flag) {
-				case 0x0:
-					/* Property Value is valid */
-					break;
-				case 0x1:
-					/* Property Value is not present */
-					havePropertyValue = false;
-					break;
-				case PT_ERROR:
-					lpProps[prop].ulPropTag = proptags->aulPropTag[prop];
-					proptag = (int) lpProps[prop].ulPropTag;
-					proptag &= 0xFFFF0000;
-					proptag |= PT_ERROR;
-					lpProps[prop].ulPropTag = (enum MAPITAGS) proptag;
-					break;
-				default:
-					/* unknown FlaggedPropertyValue flag */
-					break;
-
-				}
-			}
-			if (havePropertyValue) {
-				lpProps[prop].dwAlignPad = 0x0;
-				data = pull_emsmdb_property(mem_ctx, &offset, lpProps[prop].ulPropTag, content);
-				talloc_steal(lpProps, data);
-				set_SPropValue(&lpProps[prop], data);
-				free_emsmdb_property(&lpProps[prop], (void *) data);
-			}
-		}
+	plan = emsmdb_column_plan_init(mem_ctx, proptags);
+	if (!plan) return;
+	ndr = talloc_zero(plan, struct ndr_pull);
+	if (!ndr) {
+		talloc_free(plan);
+		return;
+	}
+	ndr->data = content->data;
+	ndr->data_size = content->length;
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
 
+	for (idx = 0; idx < row_count; idx++) {
 		rows[idx].ulAdrEntryPad = 0;
-		rows[idx].cValues = proptags->cValues;
-		rows[idx].lpProps = lpProps;
+		rows[idx].lpProps = emsmdb_pull_row(mem_ctx, ndr, plan, proptags->cValues, content, NULL);
+		rows[idx].cValues = rows[idx].lpProps ? proptags->cValues : 0;
 	}
+
+	talloc_free(plan);
 }
 
 
@@ -47,8 +47,15 @@ struct emsmdb_context {
 	struct emsmdb_info	info;
 	struct policy_handle	async_handle; ///< The handle to use for Async notification requests
 	struct dcerpc_pipe	*async_rpc_connection;
+	uint32_t		max_response_size;
+	bool			compression;
 };
 
+/* Size limits of EcDoRpcExt2 rgbOut buffers, responses larger than the
+   minimum can hold chained extended buffers */
+#define	EMSMDB_EXT2_MIN_RESPONSE	0x8007
+#define	EMSMDB_EXT2_MAX_RESPONSE	0x40000
+
 #define	MAILBOX_PATH	"/o=%s/ou=%s/cn=Recipients/cn=%s"
 
 #endif /* __EMSMDB_H__ */
@@ -369,3 +369,526 @@ _PUBLIC_ int GetFreeBusyYear(const uint32_t *publish_start)
 
 	return year;
 }
+
+
+/* Subjects looked up per Restrict call on a free/busy folder */
+#define	FREEBUSY_RESTRICT_COUNT	32
+
+struct freebusy_lookup {
+	struct mapi_freebusy	*freebusy;
+	char			*folder_name;
+	char			*message_name;
+	bool			found;
+	mapi_id_t		fid;
+	mapi_id_t		mid;
+	mapi_object_t		obj_message;
+	struct SPropValue	*lpProps;
+	uint32_t		count;
+	enum MAPISTATUS		open_status;
+	enum MAPISTATUS		status;
+};
+
+
+/**
+   \details Return the unix time of a number of minutes since January
+   1, 1601 as free/busy properties store them
+ */
+static time_t freebusy_minutes_to_time(uint32_t minutes)
+{
+	NTTIME	nttime;
+
+	nttime = minutes;
+	nttime *= 60;
+	nttime *= 10000000;
+
+	return nt_time_to_unix(nttime);
+}
+
+
+/**
+   \details Return the unix time of the beginning of a free/busy
+   month (year * 16 + month), in UTC
+ */
+static time_t freebusy_month_start(uint32_t value)
+{
+	int64_t		year = value >> 4;
+	int64_t		month = value & 0xf;
+	int64_t		era, yoe, doy, doe;
+
+	/* Days from civil date, with March as the first month */
+	year -= (month <= 2);
+	era = (year >= 0 ? year : year - 399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return (time_t) ((era * 146097 + doe - 719468) * 86400);
+}
+
+
+static int freebusy_interval_cmp(const void *a, const void *b)
+{
+	const struct mapi_freebusy_interval	*ia = (const struct mapi_freebusy_interval *)a;
+	const struct mapi_freebusy_interval	*ib = (const struct mapi_freebusy_interval *)b;
+
+	if (ia->start != ib->start) return (ia->start < ib->start) ? -1 : 1;
+	if (ia->end != ib->end) return (ia->end < ib->end) ? -1 : 1;
+	return 0;
+}
+
+
+/**
+   \details Append the events of a free/busy status to the intervals of
+   a recipient
+
+   Each month holds a list of little endian (start, end) pairs of 16 bit
+   minutes from the beginning of the month.
+ */
+static enum MAPISTATUS freebusy_decode(struct mapi_freebusy *freebusy, struct SPropValue *lpProps,
+				       uint32_t count, enum MAPITAGS months_tag, enum MAPITAGS events_tag,
+				       enum FreeBusyStatus status)
+{
+	struct SRow			aRow;
+	const struct LongArray_r	*months;
+	const struct BinaryArray_r	*events;
+	struct Binary_r			*bin;
+	struct mapi_freebusy_interval	*intervals;
+	time_t				month_start;
+	uint32_t			i, j;
+
+	aRow.cValues = count;
+	aRow.lpProps = lpProps;
+	months = (const struct LongArray_r *) find_SPropValue_data(&aRow, months_tag);
+	events = (const struct BinaryArray_r *) find_SPropValue_data(&aRow, events_tag);
+	if (!months || !events) return MAPI_E_SUCCESS;
+
+	for (i = 0; i < months->cValues && i < events->cValues; i++) {
+		bin = &events->lpbin[i];
+		if (bin->cb % 4) return MAPI_E_CORRUPT_DATA;
+		if ((months->lpl[i] & 0xf) < 1 || (months->lpl[i] & 0xf) > 12) return MAPI_E_CORRUPT_DATA;
+		if (!bin->cb) continue;
+
+		intervals = talloc_realloc(freebusy, freebusy->intervals, struct mapi_freebusy_interval,
+					   freebusy->count + bin->cb / 4);
+		OPENCHANGE_RETVAL_IF(!intervals, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		freebusy->intervals = intervals;
+
+		month_start = freebusy_month_start(months->lpl[i]);
+		for (j = 0; j < bin->cb; j += 4) {
+			intervals[freebusy->count].start = month_start + 60 * ((bin->lpb[j + 1] << 8) | bin->lpb[j]);
+			intervals[freebusy->count].end = month_start + 60 * ((bin->lpb[j + 3] << 8) | bin->lpb[j + 2]);
+			intervals[freebusy->count].status = status;
+			freebusy->count++;
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Queue the retrieval of the free/busy message of a recipient:
+   open, read and release it
+ */
+static enum MAPISTATUS freebusy_queue_step(struct mapi_batch *batch, mapi_object_t *obj_folder,
+					   struct freebusy_lookup *lookup, struct SPropTagArray *SPropTagArray,
+					   int step)
+{
+	switch (step) {
+	case 0:
+		return mapi_batch_OpenMessage(batch, obj_folder, lookup->fid, lookup->mid,
+					      &lookup->obj_message, 0x0, &lookup->open_status);
+	case 1:
+		return mapi_batch_GetProps(batch, &lookup->obj_message, 0, SPropTagArray,
+					   &lookup->lpProps, &lookup->count, &lookup->status);
+	default:
+		return mapi_batch_Release(batch, &lookup->obj_message, NULL);
+	}
+}
+
+
+/**
+   \details Find the free/busy messages of the recipients published in
+   a free/busy folder
+ */
+static enum MAPISTATUS freebusy_find_messages(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder,
+					      const char *folder_name, struct freebusy_lookup *lookups,
+					      uint32_t count)
+{
+	enum MAPISTATUS			retval;
+	mapi_object_t			obj_ctable;
+	struct SPropTagArray		*SPropTagArray;
+	struct mapi_SRestriction	res;
+	struct SRowSet			SRowSet;
+	const char			*subject;
+	const uint64_t			*fid;
+	const uint64_t			*mid;
+	uint32_t			chunk[FREEBUSY_RESTRICT_COUNT];
+	uint32_t			chunk_count;
+	uint32_t			i, j, k;
+
+	mapi_object_init(&obj_ctable);
+	retval = GetContentsTable(obj_folder, &obj_ctable, 0, NULL);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x3,
+					  PR_FID,
+					  PR_MID,
+					  PR_NORMALIZED_SUBJECT);
+	retval = SetColumns(&obj_ctable, SPropTagArray);
+	MAPIFreeBuffer(SPropTagArray);
+	if (retval) goto end;
+
+	res.rt = RES_OR;
+	res.res.resOr.res = talloc_array(mem_ctx, struct mapi_SRestriction_or, FREEBUSY_RESTRICT_COUNT);
+	if (!res.res.resOr.res) {
+		retval = MAPI_E_NOT_ENOUGH_MEMORY;
+		goto end;
+	}
+
+	for (i = 0; i < count; ) {
+		/* Restrict the table to the next recipients of the folder */
+		for (chunk_count = 0; i < count && chunk_count < FREEBUSY_RESTRICT_COUNT; i++) {
+			if (lookups[i].folder_name && !strcmp(lookups[i].folder_name, folder_name)) {
+				chunk[chunk_count] = i;
+				res.res.resOr.res[chunk_count].rt = RES_PROPERTY;
+				res.res.resOr.res[chunk_count].res.resProperty.relop = RELOP_EQ;
+				res.res.resOr.res[chunk_count].res.resProperty.ulPropTag = PR_NORMALIZED_SUBJECT;
+				res.res.resOr.res[chunk_count].res.resProperty.lpProp.ulPropTag = PR_NORMALIZED_SUBJECT;
+				res.res.resOr.res[chunk_count].res.resProperty.lpProp.value.lpszA = lookups[i].message_name;
+				chunk_count++;
+			}
+		}
+		if (!chunk_count) break;
+		res.res.resOr.cRes = chunk_count;
+
+		retval = Restrict(&obj_ctable, &res, NULL);
+		if (retval) goto end;
+
+		do {
+			retval = QueryRows(&obj_ctable, FREEBUSY_RESTRICT_COUNT, TBL_ADVANCE, TBL_FORWARD_READ, &SRowSet);
+			if (retval) goto end;
+
+			for (j = 0; j < SRowSet.cRows; j++) {
+				subject = (const char *) find_SPropValue_data(&SRowSet.aRow[j], PR_NORMALIZED_SUBJECT);
+				fid = (const uint64_t *) find_SPropValue_data(&SRowSet.aRow[j], PR_FID);
+				mid = (const uint64_t *) find_SPropValue_data(&SRowSet.aRow[j], PR_MID);
+				if (!subject || !fid || !mid) continue;
+
+				for (k = 0; k < chunk_count; k++) {
+					if (!strcasecmp(subject, lookups[chunk[k]].message_name)) {
+						lookups[chunk[k]].found = true;
+						lookups[chunk[k]].fid = *fid;
+						lookups[chunk[k]].mid = *mid;
+					}
+				}
+			}
+		} while (SRowSet.cRows);
+	}
+	retval = MAPI_E_SUCCESS;
+
+end:
+	talloc_free(res.res.resOr.res);
+	mapi_object_release(&obj_ctable);
+
+	return retval;
+}
+
+
+/**
+   \details Retrieve the free/busy data of several recipients at once
+
+   Recipients are resolved with a single address book call. The
+   free/busy messages are searched by folder with restrictions on
+   their subject and read through a batch, so the number of EcDoRpc
+   round trips does not grow with each recipient.
+
+   \param mem_ctx pointer to the memory context the results are
+   allocated with
+   \param obj_store pointer to the public folder MAPI object
+   \param recipients names of the recipients
+   \param count number of recipients
+   \param freebusyp pointer on pointer to the returned array of count
+   free/busy entries, in the order of the recipients. The retval of
+   an entry is MAPI_E_NOT_FOUND when the recipient does not resolve
+   or has not published free/busy data.
+   \param bitmap pointer to an availability bitmap to fill, may be
+   NULL. The caller sets its start, slot and slots fields, the
+   function allocates the bits, set for the slots where at least one
+   recipient is tentative, busy or out of office.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+
+   \sa GetUserFreeBusyData
+ */
+_PUBLIC_ enum MAPISTATUS GetFreeBusyDataBatch(TALLOC_CTX *mem_ctx,
+					      mapi_object_t *obj_store,
+					      const char **recipients,
+					      uint32_t count,
+					      struct mapi_freebusy **freebusyp,
+					      struct mapi_freebusy_bitmap *bitmap)
+{
+	enum MAPISTATUS			retval;
+	TALLOC_CTX			*local_mem_ctx;
+	struct mapi_session		*session;
+	struct mapi_freebusy		*freebusy;
+	struct freebusy_lookup		*lookups;
+	struct mapi_batch		*batch = NULL;
+	struct PropertyRowSet_r		*pRowSet = NULL;
+	struct PropertyTagArray_r	*flaglist = NULL;
+	struct SPropTagArray		*SPropTagArray;
+	struct SPropTagArray		*FreeBusyTags;
+	struct mapi_SRestriction	res;
+	struct SRowSet			SRowSet;
+	mapi_id_t			id_freebusy;
+	mapi_object_t			obj_freebusy;
+	mapi_object_t			obj_htable;
+	mapi_object_t			obj_folder;
+	const char			**names;
+	const char			*email;
+	const uint32_t			*publish;
+	const uint64_t			*fid;
+	char				*o;
+	char				*ou;
+	char				*username;
+	time_t				slot_start, slot_end;
+	int64_t				first, last, s;
+	uint32_t			row;
+	uint32_t			i, j;
+	int				step;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!obj_store, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!recipients || !count, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!freebusyp, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(bitmap && (!bitmap->slot || !bitmap->slots), MAPI_E_INVALID_PARAMETER, NULL);
+
+	session = mapi_object_get_session(obj_store);
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_SESSION_LIMIT, NULL);
+
+	freebusy = talloc_zero_array(mem_ctx, struct mapi_freebusy, count);
+	OPENCHANGE_RETVAL_IF(!freebusy, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	local_mem_ctx = talloc_named(session, 0, "GetFreeBusyDataBatch");
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, freebusy);
+
+	lookups = talloc_zero_array(local_mem_ctx, struct freebusy_lookup, count);
+	names = talloc_zero_array(local_mem_ctx, const char *, count + 1);
+	if (!lookups || !names) {
+		talloc_free(freebusy);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	}
+
+	mapi_object_init(&obj_freebusy);
+	mapi_object_init(&obj_htable);
+	mapi_object_init(&obj_folder);
+
+	for (i = 0; i < count; i++) {
+		freebusy[i].recipient = talloc_strdup(freebusy, recipients[i]);
+		freebusy[i].retval = MAPI_E_NOT_FOUND;
+		lookups[i].freebusy = &freebusy[i];
+		mapi_object_init(&lookups[i].obj_message);
+		names[i] = recipients[i];
+	}
+
+	/* Step 1. Resolve all the recipients at once and build their
+	 * FreeBusy strings */
+	SPropTagArray = set_SPropTagArray(local_mem_ctx, 0x1, PR_EMAIL_ADDRESS_UNICODE);
+	retval = ResolveNames(session, names, SPropTagArray, &pRowSet, &flaglist, MAPI_UNICODE);
+	MAPIFreeBuffer(SPropTagArray);
+	if (retval) goto end;
+
+	for (i = 0, row = 0; i < count && flaglist && i < flaglist->cValues; i++) {
+		if (flaglist->aulPropTag[i] != MAPI_RESOLVED) continue;
+		if (!pRowSet || row >= pRowSet->cRows) break;
+
+		email = (const char *) find_PropertyValue_data(&pRowSet->aRow[row++], PR_EMAIL_ADDRESS_UNICODE);
+		if (!email) continue;
+
+		o = x500_get_dn_element(local_mem_ctx, email, ORG);
+		ou = x500_get_dn_element(local_mem_ctx, email, ORG_UNIT);
+		username = x500_get_dn_element(local_mem_ctx, email, "/cn=Recipients/cn=");
+		if (!o || !ou || !username) continue;
+
+		for (j = 0; username[j]; j++) {
+			username[j] = toupper((unsigned char)username[j]);
+		}
+		lookups[i].message_name = talloc_asprintf(local_mem_ctx, FREEBUSY_USER, username);
+		lookups[i].folder_name = talloc_asprintf(local_mem_ctx, FREEBUSY_FOLDER, o, ou);
+	}
+	MAPIFreeBuffer(pRowSet);
+	MAPIFreeBuffer(flaglist);
+
+	/* Step 2. Open the FreeBusy root folder and its hierarchy table */
+	retval = GetDefaultPublicFolder(obj_store, &id_freebusy, olFolderPublicFreeBusyRoot);
+	if (retval) goto end;
+
+	retval = OpenFolder(obj_store, id_freebusy, &obj_freebusy);
+	if (retval) goto end;
+
+	retval = GetHierarchyTable(&obj_freebusy, &obj_htable, 0, NULL);
+	if (retval) goto end;
+
+	SPropTagArray = set_SPropTagArray(local_mem_ctx, 0x2,
+					  PR_FID,
+					  PR_DISPLAY_NAME);
+	retval = SetColumns(&obj_htable, SPropTagArray);
+	MAPIFreeBuffer(SPropTagArray);
+	if (retval) goto end;
+
+	FreeBusyTags = set_SPropTagArray(local_mem_ctx, 0xa,
+					 PR_FREEBUSY_PUBLISH_START,
+					 PR_FREEBUSY_PUBLISH_END,
+					 PR_SCHDINFO_MONTHS_TENTATIVE,
+					 PR_SCHDINFO_FREEBUSY_TENTATIVE,
+					 PR_SCHDINFO_MONTHS_BUSY,
+					 PR_SCHDINFO_FREEBUSY_BUSY,
+					 PR_SCHDINFO_MONTHS_OOF,
+					 PR_SCHDINFO_FREEBUSY_OOF,
+					 PR_SCHDINFO_MONTHS_MERGED,
+					 PR_SCHDINFO_FREEBUSY_MERGED);
+
+	retval = mapi_batch_begin(local_mem_ctx, session, &batch);
+	if (retval) goto end;
+
+	/* Step 3. Process the recipients folder by folder: usually all
+	 * of them belong to the same administrative group */
+	for (i = 0; i < count; i++) {
+		const char	*folder_name = lookups[i].folder_name;
+
+		if (!folder_name) continue;
+		for (j = 0; j < i; j++) {
+			if (lookups[j].folder_name && !strcmp(lookups[j].folder_name, folder_name)) break;
+		}
+		if (j < i) continue;
+
+		res.rt = RES_PROPERTY;
+		res.res.resProperty.relop = RELOP_EQ;
+		res.res.resProperty.ulPropTag = PR_DISPLAY_NAME;
+		res.res.resProperty.lpProp.ulPropTag = PR_DISPLAY_NAME;
+		res.res.resProperty.lpProp.value.lpszA = folder_name;
+		if (FindRow(&obj_htable, &res, BOOKMARK_BEGINNING, DIR_FORWARD, &SRowSet) != MAPI_E_SUCCESS) continue;
+
+		fid = (const uint64_t *) get_SPropValue_SRowSet_data(&SRowSet, PR_FID);
+		if (!fid || *fid == MAPI_E_NOT_FOUND) continue;
+
+		mapi_object_release(&obj_folder);
+		mapi_object_init(&obj_folder);
+		if (OpenFolder(&obj_freebusy, *fid, &obj_folder) != MAPI_E_SUCCESS) continue;
+
+		retval = freebusy_find_messages(local_mem_ctx, &obj_folder, folder_name, lookups, count);
+		if (retval) goto end;
+
+		/* Step 4. Read the messages found, as few round trips as
+		 * the batch limits allow */
+		for (j = i; j < count; j++) {
+			if (!lookups[j].found || strcmp(lookups[j].folder_name, folder_name)) continue;
+
+			for (step = 0; step < 3; step++) {
+				retval = freebusy_queue_step(batch, &obj_folder, &lookups[j], FreeBusyTags, step);
+				if (retval == MAPI_E_NOT_ENOUGH_RESOURCES) {
+					retval = mapi_batch_flush(batch);
+					if (retval) goto end;
+					retval = freebusy_queue_step(batch, &obj_folder, &lookups[j], FreeBusyTags, step);
+				}
+				if (retval) goto end;
+			}
+		}
+		retval = mapi_batch_flush(batch);
+		if (retval) goto end;
+	}
+
+	/* Step 5. Decode the monthly binaries into intervals */
+	for (i = 0; i < count; i++) {
+		struct SRow	aRow;
+
+		if (!lookups[i].found || lookups[i].open_status || lookups[i].status) continue;
+
+		aRow.cValues = lookups[i].count;
+		aRow.lpProps = lookups[i].lpProps;
+		publish = (const uint32_t *) find_SPropValue_data(&aRow, PR_FREEBUSY_PUBLISH_START);
+		freebusy[i].publish_start = publish ? freebusy_minutes_to_time(*publish) : 0;
+		publish = (const uint32_t *) find_SPropValue_data(&aRow, PR_FREEBUSY_PUBLISH_END);
+		freebusy[i].publish_end = publish ? freebusy_minutes_to_time(*publish) : 0;
+
+		retval = freebusy_decode(&freebusy[i], lookups[i].lpProps, lookups[i].count,
+					 PR_SCHDINFO_MONTHS_TENTATIVE, PR_SCHDINFO_FREEBUSY_TENTATIVE, olTentative);
+		if (!retval) {
+			retval = freebusy_decode(&freebusy[i], lookups[i].lpProps, lookups[i].count,
+						 PR_SCHDINFO_MONTHS_BUSY, PR_SCHDINFO_FREEBUSY_BUSY, olBusy);
+		}
+		if (!retval) {
+			retval = freebusy_decode(&freebusy[i], lookups[i].lpProps, lookups[i].count,
+						 PR_SCHDINFO_MONTHS_OOF, PR_SCHDINFO_FREEBUSY_OOF, olOutOfOffice);
+		}
+		/* Publishers that only maintain the merged busy data */
+		if (!retval && !freebusy[i].count) {
+			retval = freebusy_decode(&freebusy[i], lookups[i].lpProps, lookups[i].count,
+						 PR_SCHDINFO_MONTHS_MERGED, PR_SCHDINFO_FREEBUSY_MERGED, olBusy);
+		}
+		if (lookups[i].lpProps) {
+			MAPIFreeBuffer(lookups[i].lpProps);
+			lookups[i].lpProps = NULL;
+		}
+
+		freebusy[i].retval = retval;
+		if (retval) {
+			talloc_free(freebusy[i].intervals);
+			freebusy[i].intervals = NULL;
+			freebusy[i].count = 0;
+			continue;
+		}
+		if (freebusy[i].count) {
+			qsort(freebusy[i].intervals, freebusy[i].count, sizeof (struct mapi_freebusy_interval),
+			      freebusy_interval_cmp);
+		}
+	}
+	retval = MAPI_E_SUCCESS;
+
+	/* Step 6. Merge the recipients availability */
+	if (bitmap) {
+		bitmap->bits = talloc_zero_array(mem_ctx, uint8_t, (bitmap->slots + 7) / 8);
+		if (!bitmap->bits) {
+			retval = MAPI_E_NOT_ENOUGH_MEMORY;
+			goto end;
+		}
+
+		slot_start = bitmap->start;
+		slot_end = bitmap->start + (time_t)bitmap->slots * bitmap->slot * 60;
+		for (i = 0; i < count; i++) {
+			for (j = 0; j < freebusy[i].count; j++) {
+				if (freebusy[i].intervals[j].end <= slot_start ||
+				    freebusy[i].intervals[j].start >= slot_end) continue;
+
+				first = (MAX(freebusy[i].intervals[j].start, slot_start) - slot_start) / (bitmap->slot * 60);
+				last = (MIN(freebusy[i].intervals[j].end, slot_end) - 1 - slot_start) / (bitmap->slot * 60);
+				for (s = first; s <= last; s++) {
+					bitmap->bits[s / 8] |= (1 << (s % 8));
+				}
+			}
+		}
+	}
+
+end:
+	for (i = 0; i < count; i++) {
+		if (lookups[i].lpProps) {
+			MAPIFreeBuffer(lookups[i].lpProps);
+		}
+	}
+	if (batch) {
+		talloc_free(batch);
+	}
+	mapi_object_release(&obj_folder);
+	mapi_object_release(&obj_htable);
+	mapi_object_release(&obj_freebusy);
+	talloc_free(local_mem_ctx);
+
+	if (retval) {
+		talloc_free(freebusy);
+		return retval;
+	}
+
+	*freebusyp = freebusy;
+
+	return MAPI_E_SUCCESS;
+}
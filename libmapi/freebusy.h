@@ -0,0 +1,51 @@
+/*
+   OpenChange MAPI implementation.
+   FreeBusy header file
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LIBMAPI_FREEBUSY_H_
+#define __LIBMAPI_FREEBUSY_H_
+
+#include <time.h>
+
+/* A period a recipient is not free, [start, end[ */
+struct mapi_freebusy_interval {
+	time_t			start;
+	time_t			end;
+	enum FreeBusyStatus	status;	/* olTentative, olBusy or olOutOfOffice */
+};
+
+/* The published free/busy data of a recipient */
+struct mapi_freebusy {
+	const char			*recipient;
+	enum MAPISTATUS			retval;		/* MAPI_E_SUCCESS if the data below is valid */
+	time_t				publish_start;
+	time_t				publish_end;
+	uint32_t			count;
+	struct mapi_freebusy_interval	*intervals;	/* sorted by start */
+};
+
+/* Slots of equal length where at least one recipient is not free */
+struct mapi_freebusy_bitmap {
+	time_t			start;		/* set by the caller */
+	uint32_t		slot;		/* in minutes, set by the caller */
+	uint32_t		slots;		/* set by the caller */
+	uint8_t			*bits;		/* bit i of byte i / 8 is slot i */
+};
+
+#endif /* __LIBMAPI_FREEBUSY_H_ */
@@ -71,7 +71,7 @@ static bool pull_uint32_t(struct fx_parser_context *parser, uint32_t *val)
 	(parser->idx)++;
 	*val += parser->data.data[parser->idx] << 16;
 	(parser->idx)++;
-	*val += parser->data.data[parser->idx] << 24;
+	*val += (uint32_t)parser->data.data[parser->idx] << 24;
 	(parser->idx)++;
 	return true;
 }
@@ -218,58 +218,36 @@ static bool pull_string8(struct fx_parser_context *parser, char **pstr)
 	return true;
 }
 
-static bool fetch_ucs2_data(struct fx_parser_context *parser, uint32_t numbytes, smb_ucs2_t **data_read)
+static bool pull_unicode_nullterminated(struct fx_parser_context *parser, char **pstr)
 {
-	if ((parser->idx) + numbytes > parser->data.length) {
-		// printf("insufficient data in fetch_ucs2_data (%i requested, %zi available)\n", numbytes, (parser->data.length - parser->idx));
-		return false;
-	}
-
-	*data_read = talloc_zero_array(parser->mem_ctx, smb_ucs2_t, (numbytes/2) + 1);
-	memcpy(*data_read, &(parser->data.data[parser->idx]), numbytes);
-	parser->idx += numbytes;
-	return true;
-}
+	uint32_t	idx_local;
 
-static bool fetch_ucs2_nullterminated(struct fx_parser_context *parser, smb_ucs2_t **data_read)
-{
-	uint32_t idx_local = parser->idx;
-	bool found = false;
-	while (idx_local < parser->data.length -1) {
-		smb_ucs2_t val = 0x0000;
-		val += parser->data.data[idx_local];
-		idx_local++;
-		val += parser->data.data[idx_local] << 8;
-		idx_local++;
-		if (val == 0x0000) {
-			found = true;
-			break;
+	for (idx_local = parser->idx; idx_local + 1 < parser->data.length; idx_local += 2) {
+		if (!parser->data.data[idx_local] && !parser->data.data[idx_local + 1]) {
+			*pstr = mapi_utf16_pull_talloc(parser->mem_ctx, &(parser->data.data[parser->idx]),
+						       idx_local + 2 - parser->idx);
+			if (!*pstr)
+				return false;
+			parser->idx = idx_local + 2;
+			return true;
 		}
 	}
-	if (!found)
-		return false;
-	return fetch_ucs2_data(parser, idx_local-(parser->idx), data_read); 
+
+	return false;
 }
 
 static bool pull_unicode(struct fx_parser_context *parser, char **pstr)
 {
-	smb_ucs2_t *ucs2_data = NULL;
-	char *utf8_data = NULL;
-	size_t utf8_len;
 	uint32_t length;
 
 	if (!pull_uint32_t(parser, &length) ||
 	    parser->idx + length > parser->data.length)
 		return false;
 
-	ucs2_data = talloc_zero_array(parser->mem_ctx, smb_ucs2_t, (length/2) + 1);
-
-	if (!fetch_ucs2_data(parser, length, &ucs2_data)) {
+	*pstr = mapi_utf16_pull_talloc(parser->mem_ctx, &(parser->data.data[parser->idx]), length);
+	if (!*pstr)
 		return false;
-	}
-	pull_ucs2_talloc(parser->mem_ctx, &utf8_data, ucs2_data, &utf8_len);
-
-	*pstr = utf8_data;
+	parser->idx += length;
 
 	return true;
 }
@@ -280,9 +258,19 @@ static bool pull_binary(struct fx_parser_context *parser, struct Binary_r *bin)
 	    parser->idx + bin->cb > parser->data.length)
 		return false;
 
+	if (parser->zero_copy) {
+		bin->lpb = &(parser->data.data[parser->idx]);
+		parser->idx += bin->cb;
+		return true;
+	}
+
 	bin->lpb = talloc_array(parser->mem_ctx, uint8_t, bin->cb + 1);
+	if (!bin->lpb)
+		return false;
+	memcpy(bin->lpb, &(parser->data.data[parser->idx]), bin->cb);
+	parser->idx += bin->cb;
 
-	return pull_uint8_data(parser, bin->cb, &(bin->lpb));
+	return true;
 }
 
 /*
@@ -344,6 +332,17 @@ static bool fetch_property_value(struct fx_parser_context *parser, DATA_BLOB *bu
 	case PT_UNICODE:
 	{
 		char *str = NULL;
+		uint32_t length;
+
+		/* converted on demand by fxparser_get_unicode_value */
+		if (parser->zero_copy) {
+			if (!pull_uint32_t(parser, &length) ||
+			    parser->idx + length > parser->data.length)
+				return false;
+			parser->idx += length;
+			prop->value.lpszW = NULL;
+			break;
+		}
 		if (!pull_unicode (parser, &str))
 			return false;
 		prop->value.lpszW = str;
@@ -489,6 +488,112 @@ static bool fetch_property_value(struct fx_parser_context *parser, DATA_BLOB *bu
 	return true;
 }
 
+/*
+  whether a property value is a single string or binary preceded by its
+  length, such values may straddle several buffers
+*/
+static bool is_counted_value(uint32_t proptag)
+{
+	switch (proptag & 0xFFFF) {
+	case PT_STRING8:
+	case PT_UNICODE:
+	case PT_SVREID:
+	case PT_BINARY:
+	case PT_OBJECT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+  start receiving a counted value not complete in the current buffer,
+  the terminator added to strings is reserved
+*/
+static bool begin_counted_value(struct fx_parser_context *parser, uint32_t length)
+{
+	parser->value = talloc_size(parser->mem_ctx, (size_t)length + 3);
+	if (!parser->value) {
+		return false;
+	}
+	parser->value_length = length;
+	parser->value_filled = 0;
+
+	return true;
+}
+
+/*
+  copy the next bytes of a counted value, return how many were used
+*/
+static uint32_t fill_counted_value(struct fx_parser_context *parser, const uint8_t *data, uint32_t length)
+{
+	uint32_t needed = parser->value_length - parser->value_filled;
+
+	if (length > needed) {
+		length = needed;
+	}
+	memcpy(parser->value + parser->value_filled, data, length);
+	parser->value_filled += length;
+
+	return length;
+}
+
+/*
+  turn the received bytes of a counted value into the property value
+*/
+static void end_counted_value(struct fx_parser_context *parser)
+{
+	struct SPropValue	*prop = &(parser->lpProp);
+
+	memset(parser->value + parser->value_length, 0, 3);
+
+	parser->raw_value.data = parser->value;
+	parser->raw_value.length = parser->value_length;
+
+	switch (prop->ulPropTag & 0xFFFF) {
+	case PT_STRING8:
+		prop->value.lpszA = (const char *) parser->value;
+		break;
+	case PT_UNICODE:
+		if (parser->zero_copy) {
+			prop->value.lpszW = NULL;
+			break;
+		}
+		prop->value.lpszW = mapi_utf16_pull_talloc(parser->mem_ctx, parser->value, parser->value_length);
+		talloc_free(parser->value);
+		break;
+	default:
+		prop->value.bin.cb = parser->value_length;
+		prop->value.bin.lpb = parser->value;
+		break;
+	}
+
+	/* the value belongs to the callback, except in zero copy mode
+	   where it is only lent for the duration of the call */
+	if (!parser->zero_copy) {
+		parser->value = NULL;
+	}
+}
+
+/*
+  report a counted value once all its bytes were received
+*/
+static enum MAPISTATUS complete_counted_value(struct fx_parser_context *parser)
+{
+	enum MAPISTATUS ms = MAPI_E_SUCCESS;
+
+	end_counted_value(parser);
+	if (parser->op_property) {
+		ms = parser->op_property(parser->lpProp, parser->priv);
+	}
+	talloc_free(parser->value);
+	parser->value = NULL;
+	parser->raw_value = data_blob_null;
+	parser->state = ParserState_Entry;
+
+	return ms;
+}
+
 static bool pull_named_property(struct fx_parser_context *parser, enum MAPISTATUS *ms)
 {
 	uint8_t type = 0;
@@ -503,13 +608,12 @@ static bool pull_named_property(struct fx_parser_context *parser, enum MAPISTATU
 			return false;
 		/* printf("LID dispid: 0x%08x\n", parser->namedprop.kind.lid); */
 	} else if (type == 1) {
-		smb_ucs2_t *ucs2_data = NULL;
-		size_t utf8_len;
+		char *name = NULL;
 		parser->namedprop.ulKind = MNID_STRING;
-		if (!fetch_ucs2_nullterminated(parser, &ucs2_data))
+		if (!pull_unicode_nullterminated(parser, &name))
 			return false;
-		pull_ucs2_talloc(parser->mem_ctx, (char**)&(parser->namedprop.kind.lpwstr.Name), ucs2_data, &(utf8_len));
-		parser->namedprop.kind.lpwstr.NameSize = utf8_len;
+		parser->namedprop.kind.lpwstr.Name = name;
+		parser->namedprop.kind.lpwstr.NameSize = strlen(name) + 1;
 		/* printf("named: %s\n", parser->namedprop.kind.lpwstr.Name); */
 	} else {
 		printf("unknown named property kind: 0x%02x\n", parser->namedprop.ulKind);
@@ -554,6 +658,64 @@ _PUBLIC_ void fxparser_set_property_callback(struct fx_parser_context *parser, f
 	parser->op_property = property_callback;
 }
 
+/**
+  \details lend property values to the property callback instead of
+  copying them
+
+  In zero copy mode, binary values point into the parser buffer and
+  Unicode strings are left NULL, fxparser_get_raw_value and
+  fxparser_get_unicode_value give access to them. Values are only
+  valid until the property callback returns. This avoids a copy of
+  every attachment or body when the callback only writes them out.
+
+  \param parser pointer to the fast transfer parser
+  \param zero_copy whether values are lent rather than copied
+*/
+_PUBLIC_ void fxparser_set_zero_copy(struct fx_parser_context *parser, bool zero_copy)
+{
+	parser->zero_copy = zero_copy;
+}
+
+/**
+  \details return the encoded bytes of the string or binary value being
+  reported to the property callback
+
+  \param parser pointer to the fast transfer parser
+  \param value pointer to the blob pointing to the value bytes, only
+  valid until the property callback returns
+
+  \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if the current
+  property is not a string or binary
+*/
+_PUBLIC_ enum MAPISTATUS fxparser_get_raw_value(struct fx_parser_context *parser, DATA_BLOB *value)
+{
+	OPENCHANGE_RETVAL_IF(!parser || !value, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!parser->raw_value.data, MAPI_E_NOT_FOUND, NULL);
+
+	*value = parser->raw_value;
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+  \details convert the Unicode string being reported to the property
+  callback to UTF-8
+
+  \param parser pointer to the fast transfer parser
+  \param mem_ctx memory context to allocate the string with
+
+  \return the UTF-8 string on success, otherwise NULL
+*/
+_PUBLIC_ char *fxparser_get_unicode_value(struct fx_parser_context *parser, TALLOC_CTX *mem_ctx)
+{
+	if (!parser || !parser->raw_value.data ||
+	    (parser->lpProp.ulPropTag & 0xFFFF) != PT_UNICODE) {
+		return NULL;
+	}
+
+	return mapi_utf16_pull_talloc(mem_ctx, parser->raw_value.data, parser->raw_value.length);
+}
+
 /**
   \details initialise a fast transfer parser
 */
@@ -575,14 +737,34 @@ _PUBLIC_ struct fx_parser_context* fxparser_init(TALLOC_CTX *mem_ctx, void *priv
 
 /**
   \details parse a fast transfer buffer
+
+  The buffer can be any part of the stream, such as the content of one
+  FXGetBuffer response: callbacks are called for every marker or
+  property complete so far and the parser keeps what remains until the
+  next buffer. Strings and binaries spanning several buffers are copied
+  once into their value instead of being parsed again with every
+  buffer.
 */
 _PUBLIC_ enum MAPISTATUS fxparser_parse(struct fx_parser_context *parser, DATA_BLOB *fxbuf)
 {
 	enum MAPISTATUS ms = MAPI_E_SUCCESS;
+	uint32_t	used = 0;
+
+	/* Continue the value the previous buffer ended in directly from
+	   this one */
+	if (parser->state == ParserState_HaveValueLength) {
+		used = fill_counted_value(parser, fxbuf->data, fxbuf->length);
+		if (parser->value_filled == parser->value_length) {
+			ms = complete_counted_value(parser);
+		}
+	}
 
-	data_blob_append(parser->mem_ctx, &(parser->data), fxbuf->data, fxbuf->length);
+	data_blob_append(parser->mem_ctx, &(parser->data), fxbuf->data + used, fxbuf->length - used);
 	parser->enough_data = true;
-	while(ms == MAPI_E_SUCCESS && (parser->idx < parser->data.length) && parser->enough_data) {
+	/* A tag ending the buffer is still handled, so that markers are
+	   reported without waiting for the next buffer */
+	while(ms == MAPI_E_SUCCESS && (parser->idx < parser->data.length || parser->state != ParserState_Entry) &&
+	      parser->enough_data) {
 		uint32_t idx = parser->idx;
 
 		switch(parser->state) {
@@ -612,6 +794,14 @@ _PUBLIC_ enum MAPISTATUS fxparser_parse(struct fx_parser_context *parser, DATA_B
 					case EndAttach:
 					case StartEmbed:
 					case EndEmbed:
+					case IncrSyncChg:
+					case IncrSyncChgPartial:
+					case IncrSyncDel:
+					case IncrSyncEnd:
+					case IncrSyncRead:
+					case IncrSyncStateBegin:
+					case IncrSyncStateEnd:
+					case IncrSyncMessage:
 						if (parser->op_marker) {
 							ms = parser->op_marker(parser->tag, parser->priv);
 						}
@@ -636,6 +826,11 @@ _PUBLIC_ enum MAPISTATUS fxparser_parse(struct fx_parser_context *parser, DATA_B
 						/* standard property thing */
 						parser->lpProp.ulPropTag = (enum MAPITAGS) parser->tag;
 						parser->lpProp.dwAlignPad = 0;
+						/* MetaTagIdsetGiven has a PT_LONG tag but its
+						   value is serialized as a binary [MS-OXCFXICS] - 2.2.1.1.1 */
+						if (parser->tag == MetaTagIdsetGiven) {
+							parser->lpProp.ulPropTag = (enum MAPITAGS) ((MetaTagIdsetGiven & 0xFFFF0000) | PT_BINARY);
+						}
 						if ((parser->lpProp.ulPropTag >> 16) & 0x8000) {
 							/* this is a named property */
 							// printf("tag: 0x%08x\n", parser->tag);
@@ -656,11 +851,34 @@ _PUBLIC_ enum MAPISTATUS fxparser_parse(struct fx_parser_context *parser, DATA_B
 			}
 			case ParserState_HavePropTag:
 			{
+				uint32_t length;
+
+				if (is_counted_value(parser->lpProp.ulPropTag)) {
+					if (!pull_uint32_t(parser, &length)) {
+						parser->enough_data = false;
+						parser->idx = idx;
+						break;
+					}
+					if (parser->idx + length > parser->data.length) {
+						if (begin_counted_value(parser, length)) {
+							parser->state = ParserState_HaveValueLength;
+						} else {
+							ms = MAPI_E_NOT_ENOUGH_MEMORY;
+							parser->idx = idx;
+						}
+						break;
+					}
+					/* the whole value is there, pull it as usual */
+					parser->raw_value.data = &(parser->data.data[parser->idx]);
+					parser->raw_value.length = length;
+					parser->idx = idx;
+				}
 				if (fetch_property_value(parser, &(parser->data), &(parser->lpProp))) {
 					// printf("position %i of %zi\n", parser->idx, parser->data.length);
 					if (parser->op_property) {
 						ms = parser->op_property(parser->lpProp, parser->priv);
 					}
+					parser->raw_value = data_blob_null;
 					parser->state = ParserState_Entry;
 				} else {
 					parser->enough_data = false;
@@ -668,14 +886,25 @@ _PUBLIC_ enum MAPISTATUS fxparser_parse(struct fx_parser_context *parser, DATA_B
 				}
 				break;
 			}
+			case ParserState_HaveValueLength:
+			{
+				parser->idx += fill_counted_value(parser, &(parser->data.data[parser->idx]),
+								  parser->data.length - parser->idx);
+				if (parser->value_filled == parser->value_length) {
+					ms = complete_counted_value(parser);
+				} else {
+					parser->enough_data = false;
+				}
+				break;
+			}
 		}
 	}
-	{
-		// Remove the part of the buffer that we've used
-		uint32_t remainder_len = parser->data.length - parser->idx;
-		DATA_BLOB remainder = data_blob_talloc_named(parser->mem_ctx, &(parser->data.data[parser->idx]), remainder_len, "fast transfer parser");
-		data_blob_free(&(parser->data));
-		parser->data = remainder;
+
+	/* Remove the part of the buffer that we've used, what remains is
+	   at most an incomplete property */
+	if (parser->idx) {
+		parser->data.length -= parser->idx;
+		memmove(parser->data.data, &(parser->data.data[parser->idx]), parser->data.length);
 		parser->idx = 0;
 	}
 
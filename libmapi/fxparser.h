@@ -25,7 +25,7 @@
    We mean it.
 */
 
-enum fx_parser_state { ParserState_Entry, ParserState_HaveTag, ParserState_HavePropTag };
+enum fx_parser_state { ParserState_Entry, ParserState_HaveTag, ParserState_HavePropTag, ParserState_HaveValueLength };
 
 struct fx_parser_context {
 	TALLOC_CTX		*mem_ctx;
@@ -36,6 +36,15 @@ struct fx_parser_context {
 	struct MAPINAMEID	namedprop;	/* the current named property we are parsing */
 	bool 			enough_data;
 	uint32_t		tag;
+
+	/* a string or binary value straddling several buffers */
+	uint8_t			*value;
+	uint32_t		value_length;
+	uint32_t		value_filled;
+
+	/* values are lent to the property callback rather than copied */
+	bool			zero_copy;
+	DATA_BLOB		raw_value;	/* bytes of the string or binary being reported */
 	void			*priv;
 	
 	/* callbacks for parser actions */
@@ -32,15 +32,21 @@ struct uint32_array {
 	size_t		length;
 };
 
+/* the common high-order bytes pushed on the GLOBSET stack are kept
+   inline, the parser never copies or allocates anything but the range
+   array */
 struct GLOBSET_parser {
 	DATA_BLOB			buffer;
 	size_t				buffer_position;
-	DATA_BLOB			stack[6];
+	uint8_t				stack[6];
+	uint8_t				stack_lengths[6];
 	uint8_t				next_stack_item;
 	uint8_t				total_stack_size;
 	bool				error;
 	uint32_t			range_count;
+	uint32_t			range_alloc;
 	struct globset_range	*ranges;
+	TALLOC_CTX			*mem_ctx;
 };
 
 /**
@@ -56,148 +62,137 @@ _PUBLIC_ uint64_t exchange_globcnt(uint64_t globcnt)
 		| (globcnt & 0x0000ff0000000000LL)	>> 40);
 }
 
-static inline void GLOBSET_parser_do_push(struct GLOBSET_parser *parser, uint8_t count);
-static inline void GLOBSET_parser_do_bitmask(struct GLOBSET_parser *parser);
-static void GLOBSET_parser_do_pop(struct GLOBSET_parser *parser);
-static void GLOBSET_parser_do_range(struct GLOBSET_parser *parser);
-
-static inline void GLOBSET_parser_do_push(struct GLOBSET_parser *parser, uint8_t count)
+static inline bool GLOBSET_parser_has_bytes(struct GLOBSET_parser *parser, size_t count)
 {
-	DATA_BLOB *push_buffer;
-
-	if (count == 0 || count > 6 || parser->next_stack_item > 5 || parser->total_stack_size > 6) {
-		abort();
+	if (parser->buffer_position + count > parser->buffer.length) {
+		OC_DEBUG(4, "end of buffer reached unexpectedly at position %Ld",
+			  (unsigned long long) parser->buffer_position);
+		parser->error = true;
+		return false;
 	}
 
-	push_buffer = parser->stack + parser->next_stack_item;
-	push_buffer->data = parser->buffer.data + parser->buffer_position;
-	push_buffer->length = count;
-	parser->next_stack_item += 1;
-	parser->buffer_position += count;
-	parser->total_stack_size += count;
-	if (parser->total_stack_size == 6) {
-		GLOBSET_parser_do_range(parser);
-		GLOBSET_parser_do_pop(parser);
-	}
+	return true;
 }
 
-static void GLOBSET_parser_do_pop(struct GLOBSET_parser *parser)
-{
-	DATA_BLOB *push_buffer;
-
-	parser->next_stack_item -= 1;
-
-	push_buffer = parser->stack + parser->next_stack_item;
-	parser->total_stack_size -= push_buffer->length;
-}
-
-static DATA_BLOB *GLOBSET_parser_stack_combine(TALLOC_CTX *mem_ctx, struct GLOBSET_parser *parser, DATA_BLOB *additional)
+/**
+  \details builds a 6 bytes GLOBCNT from the bytes pushed on the stack
+  followed by the count bytes at the current buffer position
+*/
+static inline uint64_t GLOBSET_parser_value(struct GLOBSET_parser *parser, uint8_t count)
 {
-	DATA_BLOB *combined, *current;
+	uint64_t value = 0;
+	const uint8_t *data;
 	uint8_t i;
-	uint8_t *current_ptr;
-
-	combined = talloc_zero(mem_ctx, DATA_BLOB);
-	if (additional != NULL) {
-		combined->length = additional->length;
-	}
 
-	for (i = 0; i < parser->next_stack_item; i++) {
-		current = parser->stack + i;
-		combined->length += current->length;
+	for (i = 0; i < parser->total_stack_size; i++) {
+		value |= (uint64_t) parser->stack[i] << (8 * i);
 	}
-	combined->data = talloc_array(combined, uint8_t, combined->length);
 
-	current_ptr = combined->data;
-	for (i = 0; i < parser->next_stack_item; i++) {
-		current = parser->stack + i;
-		memcpy(current_ptr, current->data, current->length);
-		current_ptr += current->length;
-	}
-
-	if (additional && additional->length > 0) {
-		memcpy(current_ptr, additional->data, additional->length);
+	data = parser->buffer.data + parser->buffer_position;
+	for (i = 0; i < count; i++) {
+		value |= (uint64_t) data[i] << (8 * (parser->total_stack_size + i));
 	}
+	parser->buffer_position += count;
 
-	return combined;
+	return value;
 }
 
-static uint64_t GLOBSET_parser_range_value(DATA_BLOB *combined)
+/**
+  \details append a range to the array being built by the parser
+*/
+static void GLOBSET_parser_add_range(struct GLOBSET_parser *parser, uint64_t low, uint64_t high)
 {
-	uint64_t value = 0, base = 1;
-	uint8_t i;
+	struct globset_range *range;
 
-	for (i = 0; i < combined->length; i++) {
-		value += combined->data[i] * base;
-		base = base * 256;
+	if (parser->range_count == parser->range_alloc) {
+		parser->range_alloc = parser->range_alloc ? parser->range_alloc * 2 : 8;
+		parser->ranges = talloc_realloc(parser->mem_ctx, parser->ranges, struct globset_range, parser->range_alloc);
+		if (!parser->ranges) {
+			parser->error = true;
+			return;
+		}
 	}
 
-	return value;
+	range = parser->ranges + parser->range_count;
+	range->low = low;
+	range->high = high;
+	parser->range_count++;
 }
 
 static void GLOBSET_parser_do_range(struct GLOBSET_parser *parser)
 {
 	uint8_t count;
-	struct globset_range *range;
-	DATA_BLOB *combined, *additional;
-	void *mem_ctx;
-
-	mem_ctx = talloc_zero(NULL, void);
+	uint64_t low, high;
 
-	range = talloc_zero(parser, struct globset_range);
 	count = 6 - parser->total_stack_size;
-
-	if (count > 0) {
-		additional = talloc_zero(mem_ctx, DATA_BLOB);
-		additional->length = count;
-		additional->data = talloc_array(additional, uint8_t, count);
-		memcpy(additional->data, parser->buffer.data + parser->buffer_position, count);
-	}
-	else {
-		additional = NULL;
+	if (!GLOBSET_parser_has_bytes(parser, 2 * count)) {
+		return;
 	}
-	parser->buffer_position += count;
-	combined = GLOBSET_parser_stack_combine(mem_ctx, parser, additional);
-	range->low = GLOBSET_parser_range_value(combined);
 
-	if (count == 0) {
-		range->high = range->low;
-	}
-	else if (count > 0) {
-		memcpy(additional->data, parser->buffer.data + parser->buffer_position, count);
-		parser->buffer_position += count;
-		combined = GLOBSET_parser_stack_combine(mem_ctx, parser, additional);
-		range->high = GLOBSET_parser_range_value(combined);
+	low = GLOBSET_parser_value(parser, count);
+	high = (count == 0) ? low : GLOBSET_parser_value(parser, count);
+
+	GLOBSET_parser_add_range(parser, low, high);
+	/* OC_DEBUG(5, "  added range: [%.16"PRIx64":%.16"PRIx64"]", low, high); */
+}
+
+static void GLOBSET_parser_do_pop(struct GLOBSET_parser *parser)
+{
+	if (parser->next_stack_item == 0) {
+		OC_DEBUG(4, "pop command on an empty stack");
+		parser->error = true;
+		return;
 	}
 
-	DLIST_ADD_END(parser->ranges, range, void);
-	/* OC_DEBUG(5, "  added range: [%.16"PRIx64":%.16"PRIx64"] %p  %p %p", range->low, range->high, range, range->prev, range->next); */
-	parser->range_count++;
+	parser->next_stack_item -= 1;
+	parser->total_stack_size -= parser->stack_lengths[parser->next_stack_item];
+}
 
-	if (!parser->ranges) {
-		abort();
+static inline void GLOBSET_parser_do_push(struct GLOBSET_parser *parser, uint8_t count)
+{
+	if (parser->total_stack_size + count > 6) {
+		OC_DEBUG(4, "push command overflows the 6 bytes stack");
+		parser->error = true;
+		return;
+	}
+	if (!GLOBSET_parser_has_bytes(parser, count)) {
+		return;
 	}
 
-	talloc_free(mem_ctx);
+	memcpy(parser->stack + parser->total_stack_size, parser->buffer.data + parser->buffer_position, count);
+	parser->stack_lengths[parser->next_stack_item] = count;
+	parser->next_stack_item += 1;
+	parser->buffer_position += count;
+	parser->total_stack_size += count;
+	if (parser->total_stack_size == 6) {
+		GLOBSET_parser_do_range(parser);
+		GLOBSET_parser_do_pop(parser);
+	}
 }
 
+/**
+  \details decode a bitmask command: a starting value, which is part of
+  the set, followed by a mask whose bit i stands for StartingValue + i + 1
+  [OXCFXICS - 2.2.2.6.4]
+*/
 static inline void GLOBSET_parser_do_bitmask(struct GLOBSET_parser *parser)
 {
 	uint8_t mask, bit, i;
-	DATA_BLOB *combined, additional;
 	uint64_t baseValue, lowValue, highValue;
-	struct globset_range *range;
 	bool blank = false;
 
-	mask = parser->buffer.data[parser->buffer_position+1];
-	parser->buffer_position += 2;
-
-	additional.length = 1;
-	additional.data = parser->buffer.data + parser->buffer_position;
+	if (parser->total_stack_size != 5) {
+		OC_DEBUG(4, "bitmask command requires 5 bytes on the stack");
+		parser->error = true;
+		return;
+	}
+	if (!GLOBSET_parser_has_bytes(parser, 2)) {
+		return;
+	}
 
-	combined = GLOBSET_parser_stack_combine(NULL, parser, &additional);
-	baseValue = GLOBSET_parser_range_value(combined);
-	talloc_free(combined);
+	baseValue = GLOBSET_parser_value(parser, 1);
+	mask = parser->buffer.data[parser->buffer_position];
+	parser->buffer_position++;
 
 	lowValue = baseValue;
 	highValue = baseValue;
@@ -207,41 +202,41 @@ static inline void GLOBSET_parser_do_bitmask(struct GLOBSET_parser *parser)
 		if (blank) {
 			if ((mask & bit)) {
 				blank = false;
-				lowValue = baseValue + ((uint64_t) (bit + 1) << 40);
+				lowValue = baseValue + ((uint64_t) (i + 1) << 40);
 				highValue = lowValue;
 			}
 		}
 		else {
 			if ((mask & bit) == 0) {
-				range = talloc_zero(parser, struct globset_range);
-				range->low = lowValue;
-				range->high = highValue;
-				DLIST_ADD_END(parser->ranges, range, void);
-				parser->range_count++;
+				GLOBSET_parser_add_range(parser, lowValue, highValue);
 				blank = true;
 			}
 			else {
-				highValue = baseValue + ((uint64_t) (bit + 1) << 40);
+				highValue = baseValue + ((uint64_t) (i + 1) << 40);
 			}
 		}
 	}
 
 	if (!blank) {
-		range = talloc_zero(parser, struct globset_range);
-		range->low = lowValue;
-		range->high = highValue;
-		DLIST_ADD_END(parser->ranges, range, void);
-		parser->range_count++;
+		GLOBSET_parser_add_range(parser, lowValue, highValue);
 	}
 }
 
 /**
   \details deserialize a GLOBSET following the format described in [OXCFXICS - 2.2.2.5]
+
+  The ranges are decoded straight from the buffer into an array
+  preallocated from the buffer size, which only grows for streams made
+  mostly of bitmask commands.
+
+  \return a talloc'ed array of *countP ranges, in the order in which they
+  appear in the stream, or NULL on error or if the GLOBSET is empty. On
+  error, *byte_countP is set to 0.
 */
 _PUBLIC_ struct globset_range *GLOBSET_parse(TALLOC_CTX *mem_ctx, DATA_BLOB buffer, uint32_t *countP, uint32_t *byte_countP)
 {
-	struct GLOBSET_parser *parser;
-	struct globset_range *ranges, *range;
+	struct GLOBSET_parser parser;
+	struct globset_range *ranges;
 	bool end = false;
 	uint8_t command;
 
@@ -253,69 +248,67 @@ _PUBLIC_ struct globset_range *GLOBSET_parse(TALLOC_CTX *mem_ctx, DATA_BLOB buff
 		return NULL;
 	}
 
+	memset(&parser, 0, sizeof(struct GLOBSET_parser));
+	parser.buffer = buffer;
+	parser.mem_ctx = mem_ctx;
 
-	parser = talloc_zero(NULL, struct GLOBSET_parser);
-	parser->buffer = buffer;
+	/* a single value takes 7 bytes, a range from 3 to 13 bytes */
+	parser.range_alloc = buffer.length / 7 + 1;
+	parser.ranges = talloc_array(mem_ctx, struct globset_range, parser.range_alloc);
+	if (!parser.ranges) {
+		return NULL;
+	}
 
-	while (!end && !parser->error) {
-		if (parser->buffer_position >= parser->buffer.length) {
-			OC_DEBUG(4, "end of buffer reached unexpectedly at position %Ld",
-				  (unsigned long long) parser->buffer_position);
-			parser->error = true;
+	while (!end && !parser.error) {
+		if (!GLOBSET_parser_has_bytes(&parser, 1)) {
+			break;
 		}
-		else {
-			command = parser->buffer.data[parser->buffer_position];
-			parser->buffer_position++;
-			switch (command) {
-			case 0x00: /* end */
-				end = true;
-				break;
-			case 0x01: /* push 1 */
-			case 0x02: /* push 2 */
-			case 0x03: /* push 3 */
-			case 0x04: /* push 4 */
-			case 0x05: /* push 5 */
-			case 0x06: /* push 6 */
-				GLOBSET_parser_do_push(parser, command);
-				break;
-			case 0x42: /* bitmask */
-				GLOBSET_parser_do_bitmask(parser);
-				break;
-			case 0x50: /* pop */
-				GLOBSET_parser_do_pop(parser);
-				break;
-			case 0x52: /* range */
-				GLOBSET_parser_do_range(parser);
-				break;
-			default:
-				parser->error = true;
-				OC_DEBUG(4, "invalid command in blockset: %.2x", command);
-				abort();
-			}
+		command = parser.buffer.data[parser.buffer_position];
+		parser.buffer_position++;
+		switch (command) {
+		case 0x00: /* end */
+			end = true;
+			break;
+		case 0x01: /* push 1 */
+		case 0x02: /* push 2 */
+		case 0x03: /* push 3 */
+		case 0x04: /* push 4 */
+		case 0x05: /* push 5 */
+		case 0x06: /* push 6 */
+			GLOBSET_parser_do_push(&parser, command);
+			break;
+		case 0x42: /* bitmask */
+			GLOBSET_parser_do_bitmask(&parser);
+			break;
+		case 0x50: /* pop */
+			GLOBSET_parser_do_pop(&parser);
+			break;
+		case 0x52: /* range */
+			GLOBSET_parser_do_range(&parser);
+			break;
+		default:
+			parser.error = true;
+			OC_DEBUG(4, "invalid command in blockset: %.2x", command);
 		}
 	}
 
-	if (parser->error) {
+	if (parser.error || parser.range_count == 0) {
+		talloc_free(parser.ranges);
 		ranges = NULL;
-		/* abort(); */
 	}
 	else {
-		ranges = parser->ranges;
-		if (countP) {
-			*countP = parser->range_count;
-		}
-		if (byte_countP) {
-			*byte_countP = parser->buffer_position;
-		}
-		if (ranges) {
-			range = ranges;
-			while (range) {
-				(void) talloc_reference(mem_ctx, range);
-				range = range->next;
-			}
+		ranges = parser.ranges;
+		if (parser.range_count < parser.range_alloc) {
+			ranges = talloc_realloc(mem_ctx, ranges, struct globset_range, parser.range_count);
 		}
 	}
-	talloc_free(parser);
+
+	if (countP) {
+		*countP = parser.error ? 0 : parser.range_count;
+	}
+	if (byte_countP) {
+		*byte_countP = parser.error ? 0 : parser.buffer_position;
+	}
 
 	return ranges;
 }
@@ -324,7 +317,6 @@ _PUBLIC_ struct globset_range *GLOBSET_parse(TALLOC_CTX *mem_ctx, DATA_BLOB buff
 static void check_idset(const struct idset *idset)
 {
 	uint32_t i;
-	struct globset_range *range, *last_range;
 
 	while (idset) {
 		if (!idset->idbased && GUID_all_zero(&idset->repl.guid)) {
@@ -332,29 +324,16 @@ static void check_idset(const struct idset *idset)
 			abort();
 		}
 
-		i = 0;
-		if (idset->ranges) {
-			range = idset->ranges;
-			while (range) {
-				/* OC_DEBUG(5, ("range %d: [%.16Lx:%.16Lx] prev: %p; next: %p", i, range->low, range->high, range->prev, range->next)); */
-				if (range->prev == NULL) {
-					OC_DEBUG(5, "range %d has a NULL prev", i);
-					abort();
-				}
-				i++;
-				last_range = range;
-				range = range->next;
-			}
-			
-			if (idset->ranges->prev != last_range) {
-				OC_DEBUG(5, "idset: last element of linked list is not the expected one");
-				abort();
-			}
+		if (idset->range_count && !idset->ranges) {
+			OC_DEBUG(5, "idset: %d elements reported but no range array", idset->range_count);
+			abort();
 		}
 
-		if (i != idset->range_count) {
-			OC_DEBUG(5, "idset: elements count does not match the reported value (%d and %d)", i, idset->range_count);
-			abort();
+		for (i = 1; i < idset->range_count; i++) {
+			if (exchange_globcnt(idset->ranges[i].low) <= exchange_globcnt(idset->ranges[i-1].high)) {
+				OC_DEBUG(5, "idset: range %d is not sorted or overlaps its predecessor", i);
+				abort();
+			}
 		}
 		idset = idset->next;
 	}
@@ -363,12 +342,35 @@ static void check_idset(const struct idset *idset)
 #define check_idset(x) {}
 #endif
 
+static int IDSET_range_compar(const void *vap, const void *vbp);
+static void IDSET_compact_ranges(struct idset *idset);
+
+/**
+  \details sort and compact the ranges of an idset unless they already
+  are in ascending and non-overlapping order, which is what every
+  function below relies upon
+*/
+static void IDSET_normalize_ranges(struct idset *idset)
+{
+	uint32_t i;
+
+	for (i = 1; i < idset->range_count; i++) {
+		if (exchange_globcnt(idset->ranges[i].low) <= exchange_globcnt(idset->ranges[i-1].high)) {
+			break;
+		}
+	}
+	if (i >= idset->range_count) return;
+
+	qsort(idset->ranges, idset->range_count, sizeof(struct globset_range), IDSET_range_compar);
+	IDSET_compact_ranges(idset);
+}
+
 /**
   \details deserialize an IDSET following the format described in [OXCFXICS - 2.2.2.4]
 */
 _PUBLIC_ struct idset *IDSET_parse(TALLOC_CTX *mem_ctx, DATA_BLOB buffer, bool idbased)
 {
-	struct idset		*idset = NULL, *prev_idset = NULL;
+	struct idset		*idset = NULL, *prev_idset = NULL, *head_idset = NULL;
 	DATA_BLOB		guid_blob, globset;
 	uint32_t		total_bytes, byte_count, id_length;
 
@@ -377,36 +379,44 @@ _PUBLIC_ struct idset *IDSET_parse(TALLOC_CTX *mem_ctx, DATA_BLOB buffer, bool i
 	if (buffer.length < id_length) return NULL;
 
 	total_bytes = 0;
-	while (total_bytes < buffer.length) {
+	while (total_bytes + id_length <= buffer.length) {
 		idset = talloc_zero(mem_ctx, struct idset);
 		if (prev_idset) {
 			prev_idset->next = idset;
 		}
+		else {
+			head_idset = idset;
+		}
 
 		idset->idbased = idbased;
 		if (idbased) {
 			idset->repl.id = (buffer.data[total_bytes] | (buffer.data[total_bytes+1] << 8));
 		} else {
-			guid_blob.data = buffer.data;
+			guid_blob.data = buffer.data + total_bytes;
 			guid_blob.length = id_length;
 			GUID_from_data_blob(&guid_blob, &idset->repl.guid);
 		}
 
 		total_bytes += id_length;
-		globset.length = buffer.length - id_length;
-		globset.data = (uint8_t *) buffer.data + id_length;
+		globset.length = buffer.length - total_bytes;
+		globset.data = (uint8_t *) buffer.data + total_bytes;
 		idset->ranges = GLOBSET_parse(idset, globset, &idset->range_count, &byte_count);
-		
-		total_bytes += byte_count;
+		IDSET_normalize_ranges(idset);
 
 		check_idset(idset);
 
 		prev_idset = idset;
+
+		if (byte_count == 0) {
+			OC_DEBUG(4, "invalid GLOBSET at offset %d", total_bytes);
+			break;
+		}
+		total_bytes += byte_count;
 	}
 
-	IDSET_dump(idset, "freshly parsed");
+	IDSET_dump(head_idset, "freshly parsed");
 
-	return idset;
+	return head_idset;
 }
 
 static int IDSET_ID_compar(const void *vap, const void *vbp)
@@ -465,8 +475,8 @@ static int IDSET_range_compar(const void *vap, const void *vbp)
 {
 	const struct globset_range *ap, *bp;
 
-	ap = *(const struct globset_range **) vap;
-	bp = *(const struct globset_range **) vbp;
+	ap = (const struct globset_range *) vap;
+	bp = (const struct globset_range *) vbp;
 
 	return IDSET_globcnt_compar(&ap->low, &bp->low);
 }
@@ -492,14 +502,17 @@ static struct idset *IDSET_make(TALLOC_CTX *mem_ctx, bool idbased, uint16_t base
 	}
 	idset->single = single;
 
-	current_globset = talloc_zero(idset, struct globset_range);
-	DLIST_ADD_END(idset->ranges, current_globset, end);
-	idset->range_count = 1;
-
 	if (length == 0) {
+		idset->ranges = talloc_zero(idset, struct globset_range);
+		idset->range_count = 1;
 		return idset;
 	}
 
+	/* there cannot be more ranges than ids */
+	idset->ranges = talloc_array(idset, struct globset_range, length);
+	current_globset = idset->ranges;
+	idset->range_count = 1;
+
 	work_array = talloc_memdup(NULL, array, sizeof(uint64_t) * length);
 	qsort(work_array, length, sizeof(uint64_t), IDSET_globcnt_compar);
 
@@ -520,8 +533,7 @@ static struct idset *IDSET_make(TALLOC_CTX *mem_ctx, bool idbased, uint16_t base
 		for (i = 1; i < length; i++) {
 			if ((exchange_globcnt(work_array[i]) != last_consequent) && (exchange_globcnt(work_array[i]) != (last_consequent + 1))) {
 				current_globset->high = exchange_globcnt(last_consequent);
-				current_globset = talloc_zero(idset, struct globset_range);
-				DLIST_ADD_END(idset->ranges, current_globset, void);
+				current_globset++;
 				idset->range_count++;
 				current_globset->low = work_array[i];
 			}
@@ -531,62 +543,97 @@ static struct idset *IDSET_make(TALLOC_CTX *mem_ctx, bool idbased, uint16_t base
 	}
 
 	talloc_free(work_array);
+	if (idset->range_count < length) {
+		idset->ranges = talloc_realloc(idset, idset->ranges, struct globset_range, idset->range_count);
+	}
 
 	check_idset(idset);
 
 	return idset;
 }
 
+/**
+  \details returns the number of low-order bytes (in the serialized byte
+  order) shared by both ends of a range, i.e. the size of the push
+  preceding its range command
+*/
+static inline uint8_t GLOBSET_range_common_bytes(const struct globset_range *range)
+{
+	uint8_t i = 0;
+	uint64_t mask = 0xff;
+
+	while (i < 6 && (range->low & mask) == (range->high & mask)) {
+		mask <<= 8;
+		i++;
+	}
+
+	return i;
+}
+
+static inline uint32_t GLOBSET_range_serialized_size(const struct globset_range *range)
+{
+	uint8_t i;
+
+	if (range->low == range->high) {
+		return 7; /* push 6 */
+	}
+
+	i = GLOBSET_range_common_bytes(range);
+	if (i > 0 && i < 6) {
+		return 1 + i + 1 + 2 * (6 - i) + 1; /* push i, range, pop */
+	}
+
+	return 1 + 2 * 6; /* range */
+}
+
 /* start: [0|1|2|3|4|5] -- count --> */
-static void GLOBSET_ndr_push_shifted_id(struct ndr_push *ndr, uint64_t range_id, uint8_t start, uint8_t count)
+static inline uint8_t *GLOBSET_push_shifted_id(uint8_t *data, uint64_t range_id, uint8_t start, uint8_t count)
 {
-	uint8_t i, steps, byte;
+	uint8_t i;
 
 	for (i = 0; i < count; i++) {
-		steps = start + i;
-		byte = (range_id >> (8 * steps)) & 0xff;
-		ndr_push_uint8(ndr, NDR_SCALARS, byte);
+		*data++ = (range_id >> (8 * (start + i))) & 0xff;
 	}
+
+	return data;
 }
 
-static void GLOBSET_ndr_push_globset_range(struct ndr_push *ndr, struct globset_range *range)
+static uint8_t *GLOBSET_push_globset_range(uint8_t *data, const struct globset_range *range)
 {
 	uint8_t i;
-	uint64_t mask;
-	bool done;
 
 	if (range->low == range->high) {
-		ndr_push_uint8(ndr, NDR_SCALARS, 0x06); /* push 6 */
-		GLOBSET_ndr_push_shifted_id(ndr, range->low, 0, 6);
+		*data++ = 0x06; /* push 6 */
+		return GLOBSET_push_shifted_id(data, range->low, 0, 6);
 	}
-	else {
-		i = 0;
-		mask = 0xff;
-		done = false;
-		while (!done && i < 6) {
-			if ((range->low & mask) == (range->high & mask)) {
-				mask <<= 8;
-				i++;
-			}
-			else {
-				done = true;
-			}
-		}
-		if (i > 0 && i < 6) {
-			/* push i */
-			ndr_push_uint8(ndr, NDR_SCALARS, i);
-			GLOBSET_ndr_push_shifted_id(ndr, range->low, 0, i);
-		}
 
-		ndr_push_uint8(ndr, NDR_SCALARS, 0x52); /* range */
-		GLOBSET_ndr_push_shifted_id(ndr, range->low, i, 6 - i);
-		GLOBSET_ndr_push_shifted_id(ndr, range->high, i, 6 - i);
+	i = GLOBSET_range_common_bytes(range);
+	if (i > 0 && i < 6) {
+		/* push i */
+		*data++ = i;
+		data = GLOBSET_push_shifted_id(data, range->low, 0, i);
+	}
 
-		if (i > 0 && i < 6) {
-			/* pop */
-			ndr_push_uint8(ndr, NDR_SCALARS, 0x50);
-		}
+	*data++ = 0x52; /* range */
+	data = GLOBSET_push_shifted_id(data, range->low, i, 6 - i);
+	data = GLOBSET_push_shifted_id(data, range->high, i, 6 - i);
+
+	if (i > 0 && i < 6) {
+		*data++ = 0x50; /* pop */
 	}
+
+	return data;
+}
+
+static uint8_t *IDSET_push_GUID(uint8_t *data, const struct GUID *guid)
+{
+	data = GLOBSET_push_shifted_id(data, guid->time_low, 0, 4);
+	data = GLOBSET_push_shifted_id(data, guid->time_mid, 0, 2);
+	data = GLOBSET_push_shifted_id(data, guid->time_hi_and_version, 0, 2);
+	memcpy(data, guid->clock_seq, 2);
+	memcpy(data + 2, guid->node, 6);
+
+	return data + 8;
 }
 
 static int IDSET_count(const struct idset *idset)
@@ -637,88 +684,45 @@ static void IDSET_reorder_idset(struct idset **idsetP)
 	talloc_free(idsets);
 }
 
-static void IDSET_reorder_ranges(struct idset *idset)
+/**
+  \details merge the overlapping ranges of a sorted idset in place, or
+  collapse them into a single one for "single" idsets
+*/
+static void IDSET_compact_ranges(struct idset *idset)
 {
-	struct globset_range *range;
-	struct globset_range **ranges;
+	struct globset_range *range, *next_range;
 	uint32_t i;
 
 	if (!idset || idset->range_count < 2) return;
 
-	ranges = talloc_array(NULL, struct globset_range *, idset->range_count);
 	range = idset->ranges;
-	for (i = 0; i < idset->range_count; i++) {
-		ranges[i] = range;
-		range = range->next;
-	}
-
-	qsort(ranges, idset->range_count, sizeof(struct globset_range *), IDSET_range_compar);
-
-	idset->ranges = ranges[0];
-	ranges[0]->prev = ranges[idset->range_count-1];
-	for (i = 0; i < idset->range_count - 1; i++) {
-		ranges[i]->next = ranges[i+1];
-		ranges[i+1]->prev = ranges[i];
-	}
-	ranges[idset->range_count-1]->next = NULL;
-
-	check_idset(idset);
-
-	talloc_free(ranges);
-}
-
-static void IDSET_compact_ranges(struct idset *idset)
-{
-	struct globset_range *range, *next_range, *prev_range;
-
-	if (!idset || idset->range_count < 2) return;
-
 	if (idset->single) {
-		range = idset->ranges;
-		next_range = range->next;
-		while (next_range) {
+		for (i = 1; i < idset->range_count; i++) {
+			next_range = idset->ranges + i;
 			if (exchange_globcnt(next_range->low) < exchange_globcnt(range->low)) {
 				range->low = next_range->low;
 			}
 			if (exchange_globcnt(next_range->high) > exchange_globcnt(range->high)) {
 				range->high = next_range->high;
 			}
-			prev_range = next_range;
-			next_range = next_range->next;
-			talloc_free(prev_range);
 		}
-		range->next = NULL;
-		range->prev = range;
-		idset->range_count = 1;
 	}
 	else {
-		range = idset->ranges;
-		while (range) {
-			next_range = range->next;
-			while (next_range) {
-				if (exchange_globcnt(next_range->low) >= exchange_globcnt(range->low)
-				    && exchange_globcnt(next_range->low) <= exchange_globcnt(range->high)) {		/* A[  B[...  ]A */
-					if (exchange_globcnt(next_range->high) > exchange_globcnt(range->high)) {	/* A[  B[  ]A  ]B -> A[  B[  ]AB */
-						range->high = next_range->high;
-					}
-					range->next = next_range->next;
-					if (range->next) {
-						range->next->prev = range;
-					}
-					if (idset->ranges->prev == next_range) {
-						idset->ranges->prev = range;
-					}
-					idset->range_count--;
-					talloc_free(next_range);
-					next_range = range->next;
-				}
-				else {
-					next_range = NULL;
+		for (i = 1; i < idset->range_count; i++) {
+			next_range = idset->ranges + i;
+			if (exchange_globcnt(next_range->low) >= exchange_globcnt(range->low)
+			    && exchange_globcnt(next_range->low) <= exchange_globcnt(range->high)) {		/* A[  B[...  ]A */
+				if (exchange_globcnt(next_range->high) > exchange_globcnt(range->high)) {	/* A[  B[  ]A  ]B -> A[  B[  ]AB */
+					range->high = next_range->high;
 				}
 			}
-			range = range->next;
+			else {
+				range++;
+				*range = *next_range;
+			}
 		}
 	}
+	idset->range_count = range - idset->ranges + 1;
 
 	check_idset(idset);
 }
@@ -726,9 +730,8 @@ static void IDSET_compact_ranges(struct idset *idset)
 /**
   \details returns an exact but totally distinct copy of an idset structure
 */
-static struct idset *IDSET_clone(TALLOC_CTX *mem_ctx, const struct idset *source_idset)
+_PUBLIC_ struct idset *IDSET_clone(TALLOC_CTX *mem_ctx, const struct idset *source_idset)
 {
-	struct globset_range *range, *clone;
 	struct idset *idset = NULL, *head_idset = NULL, *tail_idset;
 
 	if (!source_idset) return NULL;
@@ -747,14 +750,9 @@ static struct idset *IDSET_clone(TALLOC_CTX *mem_ctx, const struct idset *source
 		}
 		idset->single = source_idset->single;
 		idset->range_count = source_idset->range_count;
-
-		range = source_idset->ranges;
-		while (range) {
-			clone = talloc_zero(idset, struct globset_range);
-			clone->low = range->low;
-			clone->high = range->high;
-			DLIST_ADD_END(idset->ranges, clone, void);
-			range = range->next;
+		if (source_idset->range_count) {
+			idset->ranges = talloc_memdup(idset, source_idset->ranges,
+						      source_idset->range_count * sizeof(struct globset_range));
 		}
 
 		if (!head_idset) {
@@ -771,6 +769,48 @@ static struct idset *IDSET_clone(TALLOC_CTX *mem_ctx, const struct idset *source
 	return head_idset;
 }
 
+/**
+  \details merge the sorted ranges of two idsets sharing the same replica
+  into the first one, in a single pass over both range arrays
+*/
+static void IDSET_merge_ranges(struct idset *idset, const struct idset *other)
+{
+	struct globset_range *merged, *range, *next_range;
+	uint32_t i = 0, j = 0, count = 0;
+
+	merged = talloc_array(idset, struct globset_range, idset->range_count + other->range_count);
+	while (i < idset->range_count || j < other->range_count) {
+		if (j >= other->range_count
+		    || (i < idset->range_count
+			&& exchange_globcnt(idset->ranges[i].low) <= exchange_globcnt(other->ranges[j].low))) {
+			next_range = idset->ranges + i;
+			i++;
+		}
+		else {
+			next_range = other->ranges + j;
+			j++;
+		}
+
+		range = merged + count - 1;
+		if (count > 0 && exchange_globcnt(next_range->low) <= exchange_globcnt(range->high)) {
+			if (exchange_globcnt(next_range->high) > exchange_globcnt(range->high)) {
+				range->high = next_range->high;
+			}
+		}
+		else {
+			merged[count] = *next_range;
+			count++;
+		}
+	}
+
+	talloc_free(idset->ranges);
+	idset->ranges = merged;
+	idset->range_count = count;
+	if (idset->single) {
+		IDSET_compact_ranges(idset);
+	}
+}
+
 /**
   \details merge two idsets structures into a third one
 */
@@ -779,8 +819,7 @@ _PUBLIC_ struct idset *IDSET_merge_idsets(TALLOC_CTX *mem_ctx, const struct idse
 	struct idset *merged_idset, *clone_right, *current, *next;
 	uint16_t current_id = 0, next_id;
 	struct GUID *current_guid = NULL, *next_guid;
-	bool added_ranges = false, same_id, idbased;
-	struct globset_range *range;
+	bool same_id, idbased;
 
 	if (!left || left->range_count == 0) return IDSET_clone(mem_ctx, right);
 	if (!right || right->range_count == 0) return IDSET_clone(mem_ctx, left);
@@ -798,31 +837,21 @@ _PUBLIC_ struct idset *IDSET_merge_idsets(TALLOC_CTX *mem_ctx, const struct idse
 
 	current = merged_idset;
 	idbased = current->idbased;
-	if (idbased) {
-		current_id = current->repl.id;
-	} else {
-		current_guid = &current->repl.guid;
-	}
 	while (current->next) {
 		next = current->next;
 
 		if (idbased) {
+			current_id = current->repl.id;
 			next_id = next->repl.id;
 			same_id = (current_id == next_id);
 		} else {
+			current_guid = &current->repl.guid;
 			next_guid = &next->repl.guid;
 			same_id = GUID_equal(current_guid, next_guid);
 		}
 		
 		if (same_id) {
-			added_ranges = true;
-			current->range_count += next->range_count;
-			range = next->ranges;
-			current->ranges->prev->next = range;
-			while (range) {
-				(void) talloc_reference(current, range);
-				range = range->next;
-			}
+			IDSET_merge_ranges(current, next);
 			current->next = next->next;
 			talloc_free(next);
 		}
@@ -831,64 +860,121 @@ _PUBLIC_ struct idset *IDSET_merge_idsets(TALLOC_CTX *mem_ctx, const struct idse
 		}
 	}
 
-	if (added_ranges) {
-		current = merged_idset;
-		while (current) {
-			IDSET_reorder_ranges(current);
-			IDSET_compact_ranges(current);
-			current = current->next;
+	check_idset(merged_idset);
+
+	return merged_idset;
+}
+
+/**
+  \details returns the exact number of bytes IDSET_serialize_to_buffer
+  writes for an idset structure
+
+  \param idset pointer to the idset structure
+
+  \return the size in bytes of the serialized idset
+*/
+_PUBLIC_ uint32_t IDSET_serialized_size(const struct idset *idset)
+{
+	uint32_t size = 0;
+	uint32_t i;
+
+	while (idset) {
+		size += idset->idbased ? 2 : 16;
+		for (i = 0; i < idset->range_count; i++) {
+			size += GLOBSET_range_serialized_size(idset->ranges + i);
 		}
+		size += 1; /* end */
+		idset = idset->next;
 	}
 
-	return merged_idset;
+	return size;
 }
 
 /**
-  \details serialize an idset structure in a struct SBinary_r
+  \details serialize an idset structure into a caller-provided buffer
+
+  \param idset pointer to the idset structure to serialize
+  \param buffer pointer to the output buffer
+  \param length size of buffer in bytes, see IDSET_serialized_size
+
+  \return the number of bytes written, or 0 if buffer is too small
 */
-_PUBLIC_ struct Binary_r *IDSET_serialize(TALLOC_CTX *mem_ctx, const struct idset *idset)
+_PUBLIC_ uint32_t IDSET_serialize_to_buffer(const struct idset *idset, uint8_t *buffer, uint32_t length)
 {
-	struct ndr_push	*ndr;
-	struct globset_range *current_range;
-	struct Binary_r *data;
+	uint8_t *data = buffer;
+	uint32_t i;
 
-	check_idset(idset);
+	if (!buffer || IDSET_serialized_size(idset) > length) {
+		return 0;
+	}
 
-	ndr = ndr_push_init_ctx(NULL);
-	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
-	ndr->offset = 0;
+	check_idset(idset);
 
 	while (idset) {
 		if (idset->idbased) {
-			ndr_push_uint16(ndr, NDR_SCALARS, idset->repl.id);
+			data = GLOBSET_push_shifted_id(data, idset->repl.id, 0, 2);
 		} else {
-			ndr_push_GUID(ndr, NDR_SCALARS, &idset->repl.guid);
+			data = IDSET_push_GUID(data, &idset->repl.guid);
 		}
 
-		current_range = idset->ranges;
-		while (current_range) {
-			GLOBSET_ndr_push_globset_range(ndr, current_range);
-			current_range = current_range->next;
+		for (i = 0; i < idset->range_count; i++) {
+			data = GLOBSET_push_globset_range(data, idset->ranges + i);
 		}
-		ndr_push_uint8(ndr, NDR_SCALARS, 0x00); /* end */
+		*data++ = 0x00; /* end */
 		idset = idset->next;
 	}
 
+	return data - buffer;
+}
+
+/**
+  \details serialize an idset structure in a struct SBinary_r
+*/
+_PUBLIC_ struct Binary_r *IDSET_serialize(TALLOC_CTX *mem_ctx, const struct idset *idset)
+{
+	struct Binary_r *data;
+
 	data = talloc_zero(mem_ctx, struct Binary_r);
-	data->cb = ndr->offset;
-	data->lpb = ndr->data;
-	(void) talloc_reference(data, data->lpb);
-	talloc_free(ndr);
+	data->cb = IDSET_serialized_size(idset);
+	data->lpb = talloc_array(data, uint8_t, data->cb);
+	data->cb = IDSET_serialize_to_buffer(idset, data->lpb, data->cb);
 
 	return data;
 }
 
+/**
+  \details tests the presence of a globcnt in the sorted, non-overlapping
+  ranges of an idset by looking up the last range starting at or before it
+*/
+static bool IDSET_ranges_include_globcnt(const struct idset *idset, uint64_t globcnt)
+{
+	const struct globset_range *range;
+	uint32_t low = 0, high = idset->range_count, middle;
+	uint64_t work_globcnt;
+
+	work_globcnt = exchange_globcnt(globcnt);
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (exchange_globcnt(idset->ranges[middle].low) <= work_globcnt) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+	if (low == 0) {
+		return false;
+	}
+
+	range = idset->ranges + low - 1;
+	return (exchange_globcnt(range->high) >= work_globcnt);
+}
+
 /**
   \details tests the presence of a specific id in the ranges of a ReplID-based idset structure
 */
 _PUBLIC_ bool IDSET_includes_eid(const struct idset *idset, uint64_t eid)
 {
-	struct globset_range *range;
 	uint16_t eid_id;
 	uint64_t eid_globcnt;
 
@@ -900,15 +986,8 @@ _PUBLIC_ bool IDSET_includes_eid(const struct idset *idset, uint64_t eid)
 	eid_globcnt = eid >> 16;
 
 	while (idset) {
-		if (idset->repl.id == eid_id) {
-			range = idset->ranges;
-			while (range) {
-				if (exchange_globcnt(range->low) <= exchange_globcnt(eid_globcnt)
-				    && exchange_globcnt(range->high) >= exchange_globcnt(eid_globcnt)) {
-					return true;
-				}
-				range = range->next;
-			}
+		if (idset->repl.id == eid_id && IDSET_ranges_include_globcnt(idset, eid_globcnt)) {
+			return true;
 		}
 		idset = idset->next;
 	}
@@ -921,8 +1000,6 @@ _PUBLIC_ bool IDSET_includes_eid(const struct idset *idset, uint64_t eid)
 */
 _PUBLIC_ bool IDSET_includes_guid_glob(const struct idset *idset, struct GUID *replica_guid, uint64_t id)
 {
-	struct globset_range *range;
-
 	if (!idset || idset->idbased) {
 		return false;
 	}
@@ -931,14 +1008,8 @@ _PUBLIC_ bool IDSET_includes_guid_glob(const struct idset *idset, struct GUID *r
 	}
 
 	while (idset) {
-		if (GUID_equal(&idset->repl.guid, replica_guid)) {
-			range = idset->ranges;
-			while (range) {
-				if (exchange_globcnt(range->low) <= exchange_globcnt(id) && exchange_globcnt(range->high) >= exchange_globcnt(id)) {
-					return true;
-				}
-				range = range->next;
-			}
+		if (GUID_equal(&idset->repl.guid, replica_guid) && IDSET_ranges_include_globcnt(idset, id)) {
+			return true;
 		}
 		idset = idset->next;
 	}
@@ -946,52 +1017,77 @@ _PUBLIC_ bool IDSET_includes_guid_glob(const struct idset *idset, struct GUID *r
 	return false;
 }
 
-static void IDSET_ranges_remove_globcnt(struct idset *idset, uint64_t eid) {
-	struct globset_range *range, *new_range;
-	bool done = false;
-	uint64_t work_eid;
-
-	work_eid = exchange_globcnt(eid);
+/**
+  \details remove a set of globcnts from the sorted ranges of an idset
+
+  The removals are sorted and applied in a single pass. The ranges are
+  first moved to the tail of an array large enough for the worst case
+  (every removal splitting a range), then rewritten from its head: each
+  source range produces at most one more range than the number of
+  removals it contains, so the write position never overtakes the read
+  position.
+*/
+static void IDSET_ranges_remove_globcnts(struct idset *idset, const uint64_t *globcnts, uint32_t count)
+{
+	struct globset_range	*range;
+	uint64_t		*work_array;
+	uint64_t		low, high, eid;
+	uint32_t		j = 0, read_pos, write_pos = 0;
+
+	if (count == 0 || idset->range_count == 0) return;
+
+	work_array = talloc_memdup(NULL, globcnts, sizeof(uint64_t) * count);
+	qsort(work_array, count, sizeof(uint64_t), IDSET_globcnt_compar);
+
+	idset->ranges = talloc_realloc(idset, idset->ranges, struct globset_range, idset->range_count + count);
+	memmove(idset->ranges + count, idset->ranges, idset->range_count * sizeof(struct globset_range));
+
+	for (read_pos = count; read_pos < idset->range_count + count; read_pos++) {
+		range = idset->ranges + read_pos;
+		low = exchange_globcnt(range->low);
+		high = exchange_globcnt(range->high);
+		if (low > high) {
+			/* keep placeholder ranges such as a fresh cnset_seen's */
+			idset->ranges[write_pos] = *range;
+			write_pos++;
+			continue;
+		}
 
-	range = idset->ranges;
-	while (!done && range) {
-		if (range->low == eid) {
-			if (range->high == eid) {
-				DLIST_REMOVE(idset->ranges, range);
-				idset->range_count--;
-				if (range->next == NULL && idset->ranges != NULL) {
-					idset->ranges->prev = range->prev;
-				}
-				talloc_free(range);
+		while (j < count && exchange_globcnt(work_array[j]) < low) {
+			j++;
+		}
+		while (low <= high && j < count && (eid = exchange_globcnt(work_array[j])) <= high) {
+			if (eid > low) {
+				idset->ranges[write_pos].low = exchange_globcnt(low);
+				idset->ranges[write_pos].high = exchange_globcnt(eid - 1);
+				write_pos++;
 			}
-			else {
-				range->low = exchange_globcnt(work_eid + 1);
+			if (eid >= low) {
+				low = eid + 1;
 			}
-			done = true;
-		}
-		else if (range->high == eid) {
-			range->high = exchange_globcnt(work_eid - 1);
-			done = true;
+			j++;
 		}
-		else if ((exchange_globcnt(range->low) < work_eid) && (exchange_globcnt(range->high) > work_eid)) {
-			new_range = talloc_zero(idset, struct globset_range);
-			new_range->low = exchange_globcnt(work_eid + 1);
-			new_range->high = range->high;
-			range->high = exchange_globcnt(work_eid - 1);
-			DLIST_ADD_AFTER(idset->ranges, new_range, range);
-			idset->range_count++;
-			done = true;
-		}
-		else {
-			range = range->next;
+		if (low <= high) {
+			idset->ranges[write_pos].low = exchange_globcnt(low);
+			idset->ranges[write_pos].high = exchange_globcnt(high);
+			write_pos++;
 		}
 	}
+
+	idset->range_count = write_pos;
+	if (write_pos) {
+		idset->ranges = talloc_realloc(idset, idset->ranges, struct globset_range, write_pos);
+	}
+	else {
+		talloc_free(idset->ranges);
+		idset->ranges = NULL;
+	}
+	talloc_free(work_array);
 }
 
 _PUBLIC_ void IDSET_remove_rawidset(struct idset *idset, const struct rawidset *rawidset)
 {
 	struct idset *current_idset;
-	int i;
 
 	if (!idset || !rawidset) {
 		return;
@@ -1022,9 +1118,7 @@ _PUBLIC_ void IDSET_remove_rawidset(struct idset *idset, const struct rawidset *
 	}
 
 	if (current_idset) {
-		for (i = 0; i < rawidset->count; i++) {
-			IDSET_ranges_remove_globcnt(current_idset, rawidset->globcnts[i]);
-		}
+		IDSET_ranges_remove_globcnts(current_idset, rawidset->globcnts, rawidset->count);
 	}
 
 	check_idset(idset);
@@ -1053,13 +1147,12 @@ _PUBLIC_ void IDSET_dump(const struct idset *idset, const char *label)
 			talloc_free(guid_str);
 		}
 
-		range = idset->ranges;
 		for (i = 0; i < idset->range_count; i++) {
+			range = idset->ranges + i;
 			OC_DEBUG(5, "  [0x%.12" PRIx64 ":0x%.12" PRIx64 "]", range->low, range->high);
 			if (exchange_globcnt(range->low) > exchange_globcnt(range->high)) {
 				oc_log(OC_LOG_ERROR, "Incorrect GLOBCNT range as high value is larger than low value");
 			}
-			range = range->next;
 		}
 
 		idset = idset->next;
@@ -1080,13 +1173,12 @@ _PUBLIC_ enum MAPISTATUS IDSET_check_ranges(const struct idset *idset)
 	uint32_t	     i;
 
 	while (idset) {
-		range = idset->ranges;
+		OPENCHANGE_RETVAL_IF(idset->range_count && !idset->ranges, ecRpcFormat, NULL);
 		for (i = 0; i < idset->range_count; i++) {
-			OPENCHANGE_RETVAL_IF(!range, ecRpcFormat, NULL);
+			range = idset->ranges + i;
 			if (exchange_globcnt(range->low) > exchange_globcnt(range->high)) {
 				return ecRpcFormat;
 			}
-			range = range->next;
 		}
 		idset = idset->next;
 	}
@@ -66,6 +66,7 @@
 #include "libmapi/property_tags.h"
 #include "libmapi/property_altnames.h"
 #include "libmapi/fxics.h"
+#include "libmapi/freebusy.h"
 
 #undef _PRINTF_ATTRIBUTE
 #define _PRINTF_ATTRIBUTE(a1, a2) PRINTF_ATTRIBUTE(a1, a2)
@@ -109,10 +110,26 @@ enum MAPISTATUS		nspi_ResolveNames(struct nspi_context *, TALLOC_CTX *, const ch
 enum MAPISTATUS		nspi_ResolveNamesW(struct nspi_context *, TALLOC_CTX *, const char **, struct SPropTagArray *, struct PropertyRowSet_r ***, struct PropertyTagArray_r ***);
 void			nspi_dump_STAT(const char *, struct STAT *);
 
+/* The following public definitions come from libmapi/batch.c */
+struct mapi_batch;
+enum MAPISTATUS		mapi_batch_begin(TALLOC_CTX *, struct mapi_session *, struct mapi_batch **);
+enum MAPISTATUS		mapi_batch_flush(struct mapi_batch *);
+
+/* The following public definitions come from libmapi/mapi_cache.c */
+struct mapi_cache;
+enum MAPISTATUS		mapi_cache_open(TALLOC_CTX *, struct mapi_session *, const char *, struct SPropTagArray *, struct mapi_cache **);
+enum MAPISTATUS		mapi_cache_sync_hierarchy(struct mapi_cache *, mapi_object_t *);
+enum MAPISTATUS		mapi_cache_sync_contents(struct mapi_cache *, mapi_object_t *);
+enum MAPISTATUS		mapi_cache_get_folder(struct mapi_cache *, TALLOC_CTX *, uint64_t, struct SRow *);
+enum MAPISTATUS		mapi_cache_get_hierarchy(struct mapi_cache *, TALLOC_CTX *, uint64_t, struct SRowSet *);
+enum MAPISTATUS		mapi_cache_get_contents(struct mapi_cache *, TALLOC_CTX *, uint64_t, struct SRowSet *);
+enum MAPISTATUS		mapi_cache_get_message(struct mapi_cache *, TALLOC_CTX *, uint64_t, uint64_t, struct SRow *);
+
 /* The following public definitions come from libmapi/emsmdb.c */
 NTSTATUS		emsmdb_transaction_null(struct emsmdb_context *, struct mapi_response **);
 NTSTATUS		emsmdb_transaction(struct emsmdb_context *, TALLOC_CTX *, struct mapi_request *, struct mapi_response **);
 NTSTATUS		emsmdb_transaction_ext2(struct emsmdb_context *, TALLOC_CTX *, struct mapi_request *, struct mapi_response **);
+NTSTATUS		emsmdb_pull_ext2_response(TALLOC_CTX *, DATA_BLOB *, struct mapi_response **);
 NTSTATUS		emsmdb_transaction_wrapper(struct mapi_session *, TALLOC_CTX *, struct mapi_request *, struct mapi_response **);
 struct emsmdb_info	*emsmdb_get_info(struct mapi_session *);
 void			emsmdb_get_SRowSet(TALLOC_CTX *, struct SRowSet *, struct SPropTagArray *, DATA_BLOB *);
@@ -124,6 +141,12 @@ enum MAPISTATUS		MAPIInitialize(struct mapi_context **, const char *);
 void			MAPIUninitialize(struct mapi_context *);
 enum MAPISTATUS		SetMAPIDumpData(struct mapi_context *, bool);
 enum MAPISTATUS		SetMAPIDebugLevel(struct mapi_context *, uint32_t);
+enum MAPISTATUS		SetMAPIResponseSize(struct mapi_context *, uint32_t);
+enum MAPISTATUS		SetMAPICompression(struct mapi_context *, bool);
+enum MAPISTATUS		SetMAPIProfileCacheTTL(struct mapi_context *, uint32_t);
+enum MAPISTATUS		SetMAPIProfileStoreReadOnly(struct mapi_context *, bool);
+enum MAPISTATUS		SetMAPIConnectionPool(struct mapi_context *, bool, uint32_t);
+enum MAPISTATUS		SetMAPIEventContext(struct mapi_context *, struct tevent_context *);
 enum MAPISTATUS		GetLoadparmContext(struct mapi_context *, struct loadparm_context **);
 
 /* The following public definitions come from libmapi/simple_mapi.c */
@@ -132,6 +155,7 @@ enum MAPISTATUS		GetDefaultFolder(mapi_object_t *, uint64_t *, const uint32_t);
 enum MAPISTATUS		GetSpecialAdditionalFolder(mapi_object_t *, uint64_t *, const uint32_t);
 bool			IsMailboxFolder(mapi_object_t *, uint64_t, uint32_t *);
 enum MAPISTATUS		GetFolderItemsCount(mapi_object_t *, uint32_t *, uint32_t *);
+enum MAPISTATUS		GetFolderTree(mapi_object_t *, struct SPropTagArray *, struct SRowSet *);
 enum MAPISTATUS		AddUserPermission(mapi_object_t *, const char *, enum ACLRIGHTS);
 enum MAPISTATUS		ModifyUserPermission(mapi_object_t *, const char *, enum ACLRIGHTS);
 enum MAPISTATUS		RemoveUserPermission(mapi_object_t *, const char *);
@@ -245,6 +269,7 @@ uint32_t		get_namedid_value(const char *propname);
 uint16_t		get_namedid_type(uint16_t untypedtag);
 
 /* The following public definitions come from libmapi/property.c */
+struct SRowSet_index;
 struct SPropTagArray	*set_SPropTagArray(TALLOC_CTX *, uint32_t, ...);
 enum MAPISTATUS		SPropTagArray_add(TALLOC_CTX *, struct SPropTagArray *, enum MAPITAGS);
 enum MAPISTATUS		SPropTagArray_delete(TALLOC_CTX *, struct SPropTagArray *, uint32_t);
@@ -258,6 +283,9 @@ enum MAPISTATUS		set_default_error_SPropValue_SRow(struct SRow *, enum MAPITAGS,
 struct SPropValue	*get_SPropValue_SRow(struct SRow *, uint32_t);
 const void		*get_SPropValue_SRow_data(struct SRow *, uint32_t);
 const void		*find_SPropValue_data(struct SRow *, uint32_t);
+struct SRowSet_index	*SRowSet_index_init(TALLOC_CTX *, struct SRowSet *, struct SPropTagArray *);
+struct SPropValue	*SRowSet_index_get_SPropValue(struct SRowSet_index *, uint32_t, uint32_t);
+const void		*SRowSet_index_find_data(struct SRowSet_index *, uint32_t, uint32_t);
 const void		*find_mapi_SPropValue_data(struct mapi_SPropValue_array *, uint32_t);
 const void		*get_mapi_SPropValue_data(struct mapi_SPropValue *);
 const void		*get_SPropValue_data(struct SPropValue *);
@@ -347,6 +375,7 @@ enum MAPISTATUS		GetSearchCriteria(mapi_object_t *, struct mapi_SRestriction *,
 
 /* The following public definitions come from libmapi/IMAPIFolder.c */
 enum MAPISTATUS		CreateMessage(mapi_object_t *, mapi_object_t *);
+enum MAPISTATUS		mapi_batch_CreateMessage(struct mapi_batch *, mapi_object_t *, mapi_object_t *, enum MAPISTATUS *);
 enum MAPISTATUS		DeleteMessage(mapi_object_t *, mapi_id_t *, uint32_t);
 enum MAPISTATUS		HardDeleteMessage(mapi_object_t *, mapi_id_t *, uint16_t);
 enum MAPISTATUS		GetMessageStatus(mapi_object_t *, mapi_id_t, uint32_t *);
@@ -362,7 +391,9 @@ enum MAPISTATUS		HardDeleteMessagesAndSubfolders(mapi_object_t *);
 
 /* The following public definitions come from libmapi/IMAPIProp.c */
 enum MAPISTATUS		GetProps(mapi_object_t *, uint32_t, struct SPropTagArray *, struct SPropValue **, uint32_t *);
+enum MAPISTATUS		mapi_batch_GetProps(struct mapi_batch *, mapi_object_t *, uint32_t, struct SPropTagArray *, struct SPropValue **, uint32_t *, enum MAPISTATUS *);
 enum MAPISTATUS		SetProps(mapi_object_t *, uint32_t, struct SPropValue *, unsigned long);
+enum MAPISTATUS		mapi_batch_SetProps(struct mapi_batch *, mapi_object_t *, struct SPropValue *, unsigned long, enum MAPISTATUS *);
 enum MAPISTATUS		SaveChangesAttachment(mapi_object_t *, mapi_object_t *, enum SaveFlags);
 enum MAPISTATUS		GetPropList(mapi_object_t *, struct SPropTagArray *);
 enum MAPISTATUS		GetPropsAll(mapi_object_t *, uint32_t, struct mapi_SPropValue_array *);
@@ -385,6 +416,9 @@ enum MAPISTATUS		Subscribe(mapi_object_t *, uint32_t *, uint16_t, bool, mapi_not
 enum MAPISTATUS		Unsubscribe(struct mapi_session *, uint32_t);
 enum MAPISTATUS		DispatchNotifications(struct mapi_session *);
 enum MAPISTATUS		MonitorNotification(struct mapi_session *, void *, struct mapi_notify_continue_callback_data *);
+enum MAPISTATUS		MonitorAsyncNotification(struct mapi_session *, mapi_async_notify_callback_t, void *);
+enum MAPISTATUS		CancelAsyncNotification(struct mapi_session *);
+enum MAPISTATUS		LoopAsyncNotifications(struct mapi_context *, struct mapi_notify_continue_callback_data *);
 
 /* The following public definitions come from libmapi/IMAPITable.c */
 enum MAPISTATUS		SetColumns(mapi_object_t *, struct SPropTagArray *);
@@ -413,6 +447,8 @@ enum MAPISTATUS		RfrGetFQDNFromLegacyDN(struct mapi_context *, struct mapi_sessi
 enum MAPISTATUS		Logoff(mapi_object_t *);
 enum MAPISTATUS		RegisterNotification(struct mapi_session *);
 enum MAPISTATUS		RegisterAsyncNotification(struct mapi_session *, uint32_t *);
+enum MAPISTATUS		SetMAPIRequestTimeout(struct mapi_session *, uint32_t);
+enum MAPISTATUS		ReleaseIdleConnections(struct mapi_context *);
 
 /* The following public definitions come from libmapi/IMessage.c */
 enum MAPISTATUS		CreateAttach(mapi_object_t *, mapi_object_t *);
@@ -427,6 +463,7 @@ enum MAPISTATUS		RemoveAllRecipients(mapi_object_t *);
 enum MAPISTATUS		SubmitMessage(mapi_object_t *);
 enum MAPISTATUS		AbortSubmit(mapi_object_t *, mapi_object_t *, mapi_object_t *);
 enum MAPISTATUS		SaveChangesMessage(mapi_object_t *, mapi_object_t *, uint8_t);
+enum MAPISTATUS		mapi_batch_SaveChangesMessage(struct mapi_batch *, mapi_object_t *, mapi_object_t *, uint8_t, enum MAPISTATUS *);
 enum MAPISTATUS		TransportSend(mapi_object_t *, struct mapi_SPropValue_array *);
 enum MAPISTATUS		GetRecipientTable(mapi_object_t *, struct SRowSet *, struct SPropTagArray *);
 enum MAPISTATUS		SetMessageReadFlag(mapi_object_t *, mapi_object_t *, uint8_t);
@@ -447,12 +484,14 @@ enum MAPISTATUS		TransportNewMail(mapi_object_t *, mapi_object_t *, mapi_object_
 
 /* The following public definitions come from libmapi/IStoreFolder.c */
 enum MAPISTATUS		OpenMessage(mapi_object_t *, mapi_id_t, mapi_id_t, mapi_object_t *, uint8_t);
+enum MAPISTATUS		mapi_batch_OpenMessage(struct mapi_batch *, mapi_object_t *, mapi_id_t, mapi_id_t, mapi_object_t *, uint8_t, enum MAPISTATUS *);
 enum MAPISTATUS		ReloadCachedInformation(mapi_object_t *);
 
 /* The following public definitions come from libmapi/IUnknown.c */
 enum MAPISTATUS		MAPIAllocateBuffer(struct mapi_context *, uint32_t, void **);
 enum MAPISTATUS		MAPIFreeBuffer(void *);
 enum MAPISTATUS		Release(mapi_object_t *);
+enum MAPISTATUS		mapi_batch_Release(struct mapi_batch *, mapi_object_t *, enum MAPISTATUS *);
 enum MAPISTATUS		GetLastError(void);
 enum MAPISTATUS		GetLongTermIdFromId(mapi_object_t *, mapi_id_t, struct LongTermId *);
 enum MAPISTATUS		GetIdFromLongTermId(mapi_object_t *, struct LongTermId, mapi_id_t *);
@@ -499,12 +538,20 @@ enum MAPISTATUS		ICSSyncGetTransferState(mapi_object_t *, mapi_object_t *);
 enum MAPISTATUS		GetUserFreeBusyData(mapi_object_t *, const char *, struct SRow *);
 enum MAPISTATUS		IsFreeBusyConflict(mapi_object_t *, struct FILETIME *, bool *);
 int			GetFreeBusyYear(const uint32_t *);
+enum MAPISTATUS		GetFreeBusyDataBatch(TALLOC_CTX *, mapi_object_t *, const char **, uint32_t, struct mapi_freebusy **, struct mapi_freebusy_bitmap *);
 
 /* The following public definitions come from libmapi/x500.c */
 char			*x500_get_dn_element(TALLOC_CTX *, const char *, const char *);
 char			*x500_truncate_dn_last_elements(TALLOC_CTX *, const char *, uint32_t);
 char			*x500_get_servername(const char *);
 
+/* The following public definitions come from libmapi/utf16.c */
+ssize_t			mapi_utf16_to_utf8(const uint8_t *, size_t, char *);
+ssize_t			mapi_utf8_to_utf16(const char *, size_t, uint8_t *);
+char			*mapi_utf16_pull_talloc(TALLOC_CTX *, const uint8_t *, size_t);
+uint8_t			*mapi_utf16_push_talloc(TALLOC_CTX *, const char *, size_t *);
+size_t			mapi_utf16_size(const char *);
+
 /* The following public definitions come from libmapi/lzfu.c */
 enum MAPISTATUS		WrapCompressedRTFStream(mapi_object_t *, DATA_BLOB *);
 enum MAPISTATUS		uncompress_rtf(TALLOC_CTX *, uint8_t *, uint32_t, DATA_BLOB *);
@@ -536,6 +583,9 @@ void 			fxparser_set_marker_callback(struct fx_parser_context *, fxparser_marker
 void 			fxparser_set_delprop_callback(struct fx_parser_context *, fxparser_delprop_callback_t);
 void 			fxparser_set_namedprop_callback(struct fx_parser_context *, fxparser_namedprop_callback_t);
 void 			fxparser_set_property_callback(struct fx_parser_context *, fxparser_property_callback_t);
+void			fxparser_set_zero_copy(struct fx_parser_context *, bool);
+enum MAPISTATUS		fxparser_get_raw_value(struct fx_parser_context *, DATA_BLOB *);
+char			*fxparser_get_unicode_value(struct fx_parser_context *, TALLOC_CTX *);
 enum MAPISTATUS		fxparser_parse(struct fx_parser_context *, DATA_BLOB *);
 
 /* The following public definitions come from libmapi/idset.c */
@@ -548,7 +598,10 @@ struct idset *		RAWIDSET_convert_to_idset(TALLOC_CTX *, const struct rawidset *)
 
 struct idset *		IDSET_parse(TALLOC_CTX *, DATA_BLOB, bool);
 struct idset *		IDSET_merge_idsets(TALLOC_CTX *mem_ctx, const struct idset *, const struct idset *);
+struct idset *		IDSET_clone(TALLOC_CTX *, const struct idset *);
 struct Binary_r *	IDSET_serialize(TALLOC_CTX *, const struct idset *);
+uint32_t		IDSET_serialized_size(const struct idset *);
+uint32_t		IDSET_serialize_to_buffer(const struct idset *, uint8_t *, uint32_t);
 bool			IDSET_includes_guid_glob(const struct idset *, struct GUID *, uint64_t);
 bool			IDSET_includes_eid(const struct idset *, uint64_t);
 void			IDSET_remove_rawidset(struct idset *, const struct rawidset *);
@@ -65,6 +65,7 @@ __BEGIN_DECLS
 void obfuscate_data(uint8_t *, uint32_t, uint8_t);
 enum ndr_err_code ndr_pull_lzxpress_decompress(struct ndr_pull *, struct ndr_pull **, ssize_t);
 enum ndr_err_code ndr_push_lzxpress_compress(struct ndr_push *, struct ndr_push *);
+bool lzxpress_compress_blob(TALLOC_CTX *, const DATA_BLOB *, DATA_BLOB *);
 enum ndr_err_code ndr_push_ExtendedException(struct ndr_push *, int, uint16_t, const struct ExceptionInfo *, const struct ExtendedException *);
 enum ndr_err_code ndr_pull_ExtendedException(struct ndr_pull *, int, uint16_t, const struct ExceptionInfo *, struct ExtendedException *);
 enum ndr_err_code ndr_push_AppointmentRecurrencePattern(struct ndr_push *, int, const struct AppointmentRecurrencePattern *);
@@ -93,8 +94,10 @@ void			emsmdb_get_SRow(TALLOC_CTX *, struct SRow *, struct SPropTagArray *, uint
 enum MAPISTATUS		emsmdb_async_connect(struct emsmdb_context *);
 bool 			server_version_at_least(struct emsmdb_context *, uint16_t, uint16_t, uint16_t, uint16_t);
 
-/* The following private definition comes from libmapi/async_emsmdb.c */
+/* The following private definitions come from libmapi/async_emsmdb.c */
 enum MAPISTATUS emsmdb_async_waitex(struct emsmdb_context *, uint32_t, uint32_t *);
+struct tevent_req *emsmdb_async_waitex_send(TALLOC_CTX *, struct tevent_context *, struct emsmdb_context *, uint32_t);
+enum MAPISTATUS emsmdb_async_waitex_recv(struct tevent_req *, uint32_t *);
 
 /* The following private definitions come from auto-generated libmapi/mapicode.c */
 void			set_errno(enum MAPISTATUS);
@@ -109,14 +112,37 @@ mapi_handle_t		mapi_object_get_handle(mapi_object_t *);
 void			mapi_object_set_handle(mapi_object_t *, mapi_handle_t);
 void			mapi_object_table_init(TALLOC_CTX *, mapi_object_t *);
 enum MAPISTATUS		mapi_object_bookmark_find(mapi_object_t *, uint32_t,struct SBinary_short *);
+enum MAPISTATUS		mapi_object_bookmark_add(mapi_object_t *, struct SBinary_short *, uint32_t *);
+enum MAPISTATUS		mapi_object_bookmark_del(mapi_object_t *, uint32_t);
+
+/* The following private definitions come from libmapi/mapi_nameid.c */
+bool			mapi_nameid_cache_lookup(struct mapi_session *, uint8_t, const struct MAPINAMEID *, uint16_t *);
+void			mapi_nameid_cache_add(struct mapi_session *, uint8_t, const struct MAPINAMEID *, uint16_t);
+void			mapi_nameid_cache_flush(struct mapi_session *, uint8_t);
 
 /* The following private definitions come from libmapi/property.c */
 enum MAPITAGS		*get_MAPITAGS_SRow(TALLOC_CTX *, struct SRow *, uint32_t *);
 uint32_t		MAPITAGS_delete_entries(enum MAPITAGS *, uint32_t, uint32_t, ...);
 size_t			get_utf8_utf16_conv_length(const char *);
 
+/* The following private definitions come from libmapi/IMSProvider.c */
+void			mapi_connection_pool_free(struct mapi_context *);
+
 /* The following private definitions come from libmapi/IProfAdmin.c */
-enum MAPISTATUS		OpenProfileStore(TALLOC_CTX *, struct ldb_context **, const char *);
+enum MAPISTATUS		OpenProfileStore(TALLOC_CTX *, struct ldb_context **, const char *, bool);
+void			mapi_profile_cache_flush(struct mapi_context *);
+
+/* The following private definitions come from libmapi/batch.c */
+typedef enum MAPISTATUS (*mapi_batch_reply_fn)(struct mapi_batch *, struct EcDoRpc_MAPI_REPL *, uint32_t, void *);
+struct mapi_session	*mapi_batch_get_session(struct mapi_batch *);
+enum MAPISTATUS		mapi_batch_get_logon_id(struct mapi_batch *, mapi_object_t *, uint8_t *);
+enum MAPISTATUS		mapi_batch_get_handle_idx(struct mapi_batch *, mapi_object_t *, uint8_t *);
+enum MAPISTATUS		mapi_batch_queue(struct mapi_batch *, mapi_object_t *, mapi_object_t *, struct EcDoRpc_MAPI_REQ *, mapi_batch_reply_fn, void *, enum MAPISTATUS *, uint8_t *);
+
+/* The following private definitions come from libmapi/mapi_cache.c */
+struct mapi_cache_sync;
+struct mapi_cache_sync	*mapi_cache_sync_init(TALLOC_CTX *, enum SynchronizationType, struct fx_parser_context **);
+enum MAPISTATUS		mapi_cache_apply(struct mapi_cache *, struct mapi_cache_sync *, uint64_t);
 
 /* The following private definitions come from libmapi/IMAPISupport.c  */
 enum MAPISTATUS		ProcessNotification(struct mapi_notify_ctx *, struct mapi_response *);
@@ -0,0 +1,1102 @@
+/*
+   OpenChange MAPI implementation.
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include "gen_ndr/ndr_exchange.h"
+
+#include <tdb.h>
+#include <fcntl.h>
+
+
+/**
+   \file mapi_cache.c
+
+   \brief Local copy of the folders and messages of a mailbox
+
+   The cache keeps, in a TDB file next to the profile database, the
+   properties of the folders and the columns of the messages of the
+   folders that were synchronized. mapi_cache_sync_hierarchy and
+   mapi_cache_sync_contents fetch what changed since the last
+   synchronization with ICS and store the new state along with the
+   changes, so each call only transfers the delta. The
+   mapi_cache_get_* functions answer from the cache without contacting
+   the server.
+
+   A session can't be used by two threads at once: synchronizing in the
+   background is left to the caller, for instance from a timer of its
+   event loop.
+ */
+
+
+/* Size of the ICSSyncUploadStateContinue chunks */
+#define	MAPI_CACHE_STATE_CHUNK	0x4000
+
+enum mapi_cache_action {
+	MAPI_CACHE_DELETE,
+	MAPI_CACHE_READ,
+	MAPI_CACHE_UNREAD
+};
+
+struct mapi_cache {
+	struct tdb_context		*tdb;
+	struct SPropTagArray		*columns;
+};
+
+struct mapi_cache_item {
+	uint64_t			id;
+	bool				partial;
+	struct SRow			row;
+};
+
+struct mapi_cache_idset {
+	enum mapi_cache_action		action;
+	struct idset			*idset;
+};
+
+/* What a synchronization brings, stored once the stream is complete */
+struct mapi_cache_sync {
+	TALLOC_CTX			*mem_ctx;
+	enum SynchronizationType	type;
+	uint32_t			marker;
+	uint32_t			depth; /* inside recipients, attachments or embedded messages */
+	bool				in_state;
+	struct mapi_cache_item		*items;
+	uint32_t			items_count;
+	int32_t				current; /* index of the item being received, -1 if none */
+	struct mapi_cache_idset		*idsets;
+	uint32_t			idsets_count;
+	struct SRow			state;
+};
+
+static const uint32_t mapi_cache_default_columns[] = {
+	PR_SUBJECT_UNICODE,
+	PR_SENT_REPRESENTING_NAME_UNICODE,
+	PR_DISPLAY_TO_UNICODE,
+	PR_MESSAGE_DELIVERY_TIME,
+	PR_MESSAGE_FLAGS,
+	PR_MESSAGE_CLASS_UNICODE,
+	PR_MESSAGE_SIZE,
+	PR_IMPORTANCE,
+	PR_HASATTACH
+};
+
+
+static TDB_DATA mapi_cache_key(const char *key)
+{
+	TDB_DATA	dbuf;
+
+	dbuf.dptr = (unsigned char *) key;
+	dbuf.dsize = strlen(key);
+
+	return dbuf;
+}
+
+
+/**
+   \details Whether a property can be stored in the cache
+ */
+static bool mapi_cache_storable(uint32_t proptag)
+{
+	/* named properties are only meaningful with their mapping */
+	if ((proptag >> 16) >= 0x8000) return false;
+
+	switch (proptag & 0xFFFF) {
+	case PT_I2:
+	case PT_LONG:
+	case PT_BOOLEAN:
+	case PT_I8:
+	case PT_STRING8:
+	case PT_UNICODE:
+	case PT_SYSTIME:
+	case PT_CLSID:
+	case PT_BINARY:
+	case PT_MV_LONG:
+	case PT_MV_STRING8:
+	case PT_MV_UNICODE:
+	case PT_MV_BINARY:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+/**
+   \details Store a row of properties under a key
+
+   Properties the cache can't store are skipped.
+ */
+static enum MAPISTATUS mapi_cache_store_row(struct mapi_cache *cache, const char *key,
+					    uint32_t cValues, struct SPropValue *lpProps)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct mapi_SPropValue_array	array;
+	enum ndr_err_code		ndr_err;
+	DATA_BLOB			blob;
+	uint32_t			i;
+	int				ret;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	array.cValues = 0;
+	array.lpProps = talloc_array(mem_ctx, struct mapi_SPropValue, cValues + 1);
+	OPENCHANGE_RETVAL_IF(!array.lpProps, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	for (i = 0; i < cValues; i++) {
+		if (!mapi_cache_storable(lpProps[i].ulPropTag)) continue;
+		if (cast_mapi_SPropValue(mem_ctx, &array.lpProps[array.cValues], &lpProps[i])) {
+			array.cValues++;
+		}
+	}
+
+	ndr_err = ndr_push_struct_blob(&blob, mem_ctx, &array, (ndr_push_flags_fn_t)ndr_push_mapi_SPropValue_array);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err), MAPI_E_CALL_FAILED, mem_ctx);
+
+	ret = tdb_store(cache->tdb, mapi_cache_key(key), (TDB_DATA){ .dptr = blob.data, .dsize = blob.length }, TDB_REPLACE);
+	OPENCHANGE_RETVAL_IF(ret, MAPI_E_DISK_ERROR, mem_ctx);
+
+	talloc_free(mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Fetch the row of properties stored under a key
+ */
+static enum MAPISTATUS mapi_cache_fetch_row(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+					    const char *key, struct SRow *row)
+{
+	struct mapi_SPropValue_array	array;
+	enum ndr_err_code		ndr_err;
+	TDB_DATA			dbuf;
+	DATA_BLOB			blob;
+	uint32_t			i;
+
+	dbuf = tdb_fetch(cache->tdb, mapi_cache_key(key));
+	OPENCHANGE_RETVAL_IF(!dbuf.dptr, MAPI_E_NOT_FOUND, NULL);
+
+	/* the values are copied out of the record */
+	blob = data_blob_const(dbuf.dptr, dbuf.dsize);
+	ndr_err = ndr_pull_struct_blob(&blob, mem_ctx, &array, (ndr_pull_flags_fn_t)ndr_pull_mapi_SPropValue_array);
+	free(dbuf.dptr);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err), MAPI_E_CORRUPT_DATA, NULL);
+
+	row->ulAdrEntryPad = 0;
+	row->cValues = array.cValues;
+	row->lpProps = talloc_array(mem_ctx, struct SPropValue, array.cValues + 1);
+	OPENCHANGE_RETVAL_IF(!row->lpProps, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	for (i = 0; i < array.cValues; i++) {
+		cast_SPropValue(row->lpProps, &array.lpProps[i], &row->lpProps[i]);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Fetch the identifiers of the messages cached for a folder
+
+   The identifiers are stored in the host byte order: the cache is not
+   meant to be shared between hosts.
+ */
+static enum MAPISTATUS mapi_cache_fetch_contents(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						 uint64_t fid, uint64_t **mids, uint32_t *count)
+{
+	TDB_DATA	dbuf;
+	char		*key;
+
+	key = talloc_asprintf(mem_ctx, "contents/%016"PRIx64, fid);
+	OPENCHANGE_RETVAL_IF(!key, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	*mids = NULL;
+	*count = 0;
+	dbuf = tdb_fetch(cache->tdb, mapi_cache_key(key));
+	talloc_free(key);
+	if (!dbuf.dptr) {
+		return MAPI_E_SUCCESS;
+	}
+
+	*count = dbuf.dsize / sizeof(uint64_t);
+	*mids = talloc_array(mem_ctx, uint64_t, *count + 1);
+	if (!*mids) {
+		free(dbuf.dptr);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	}
+	memcpy(*mids, dbuf.dptr, *count * sizeof(uint64_t));
+	free(dbuf.dptr);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+struct mapi_cache_ids {
+	TALLOC_CTX			*mem_ctx;
+	uint64_t			*ids;
+	uint32_t			count;
+};
+
+static int mapi_cache_traverse_folders(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct mapi_cache_ids	*fids = (struct mapi_cache_ids *) private_data;
+	char			buf[17];
+
+	if (key.dsize != 23 || memcmp(key.dptr, "folder/", 7)) return 0;
+	memcpy(buf, key.dptr + 7, 16);
+	buf[16] = '\0';
+
+	fids->ids = talloc_realloc(fids->mem_ctx, fids->ids, uint64_t, fids->count + 1);
+	if (!fids->ids) return -1;
+	fids->ids[fids->count++] = strtoull(buf, NULL, 16);
+
+	return 0;
+}
+
+
+static int mapi_cache_compare_ids(const void *a, const void *b)
+{
+	uint64_t	ida = *(const uint64_t *) a;
+	uint64_t	idb = *(const uint64_t *) b;
+
+	return (ida > idb) - (ida < idb);
+}
+
+
+static int mapi_cache_destructor(struct mapi_cache *cache)
+{
+	if (cache->tdb) {
+		tdb_close(cache->tdb);
+	}
+	return 0;
+}
+
+
+/**
+   \details Open the cache of a profile
+
+   \param mem_ctx pointer to the memory context
+   \param session pointer to the session whose profile is cached
+   \param path the path of the cache file, NULL for the file next to
+   the profile database
+   \param columns the message properties to cache, NULL for the
+   properties of a message list
+   \param cachep pointer on pointer to the cache to return
+
+   The cache is closed when it is freed with talloc_free.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_open(TALLOC_CTX *mem_ctx, struct mapi_session *session, const char *path,
+					 struct SPropTagArray *columns, struct mapi_cache **cachep)
+{
+	struct mapi_cache	*cache;
+	char			*dir;
+	char			*slash;
+	const uint32_t		*src;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!cachep, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!path && (!session || !session->mapi_ctx || !session->mapi_ctx->profiledb ||
+				       !session->profile || !session->profile->profname),
+			     MAPI_E_INVALID_PARAMETER, NULL);
+
+	cache = talloc_zero(mem_ctx, struct mapi_cache);
+	OPENCHANGE_RETVAL_IF(!cache, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	if (!path) {
+		dir = talloc_strdup(cache, session->mapi_ctx->profiledb);
+		OPENCHANGE_RETVAL_IF(!dir, MAPI_E_NOT_ENOUGH_MEMORY, cache);
+		slash = strrchr(dir, '/');
+		if (slash) {
+			*slash = '\0';
+		} else {
+			dir = talloc_strdup(cache, ".");
+			OPENCHANGE_RETVAL_IF(!dir, MAPI_E_NOT_ENOUGH_MEMORY, cache);
+		}
+		path = talloc_asprintf(cache, "%s/%s.cache.tdb", dir, session->profile->profname);
+		OPENCHANGE_RETVAL_IF(!path, MAPI_E_NOT_ENOUGH_MEMORY, cache);
+	}
+
+	cache->columns = talloc_zero(cache, struct SPropTagArray);
+	OPENCHANGE_RETVAL_IF(!cache->columns, MAPI_E_NOT_ENOUGH_MEMORY, cache);
+	if (columns) {
+		cache->columns->cValues = columns->cValues;
+		src = (const uint32_t *) columns->aulPropTag;
+	} else {
+		cache->columns->cValues = sizeof(mapi_cache_default_columns) / sizeof(mapi_cache_default_columns[0]);
+		src = mapi_cache_default_columns;
+	}
+	cache->columns->aulPropTag = (enum MAPITAGS *) talloc_array(cache->columns, uint32_t, cache->columns->cValues + 1);
+	OPENCHANGE_RETVAL_IF(!cache->columns->aulPropTag, MAPI_E_NOT_ENOUGH_MEMORY, cache);
+	memcpy(cache->columns->aulPropTag, src, cache->columns->cValues * sizeof(uint32_t));
+	cache->columns->aulPropTag[cache->columns->cValues] = (enum MAPITAGS) 0;
+
+	cache->tdb = tdb_open(path, 0, 0, O_RDWR|O_CREAT, 0600);
+	if (!cache->tdb) {
+		OC_DEBUG(1, "unable to open the cache %s: %s", path, strerror(errno));
+		OPENCHANGE_RETVAL_ERR(MAPI_E_DISK_ERROR, cache);
+	}
+	talloc_set_destructor(cache, mapi_cache_destructor);
+
+	*cachep = cache;
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Add a copy of a property to a row, replacing the value of
+   the same property
+ */
+static enum MAPISTATUS mapi_cache_row_set(TALLOC_CTX *mem_ctx, struct SRow *row, struct SPropValue *prop)
+{
+	uint32_t	i;
+
+	for (i = 0; i < row->cValues; i++) {
+		if (row->lpProps[i].ulPropTag == prop->ulPropTag) break;
+	}
+	if (i == row->cValues) {
+		row->lpProps = talloc_realloc(mem_ctx, row->lpProps, struct SPropValue, row->cValues + 1);
+		OPENCHANGE_RETVAL_IF(!row->lpProps, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		row->cValues++;
+	}
+	mapi_copy_spropvalues(mem_ctx, prop, &row->lpProps[i], 1);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static enum MAPISTATUS mapi_cache_sync_marker(uint32_t marker, void *priv)
+{
+	struct mapi_cache_sync	*sync = (struct mapi_cache_sync *) priv;
+	struct mapi_cache_item	*item;
+
+	switch (marker) {
+	case IncrSyncChg:
+	case IncrSyncChgPartial:
+		sync->items = talloc_realloc(sync->mem_ctx, sync->items, struct mapi_cache_item, sync->items_count + 1);
+		OPENCHANGE_RETVAL_IF(!sync->items, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		item = &sync->items[sync->items_count];
+		memset(item, 0, sizeof (struct mapi_cache_item));
+		item->partial = (marker == IncrSyncChgPartial);
+		sync->current = sync->items_count++;
+		sync->depth = 0;
+		break;
+	case StartRecip:
+	case NewAttach:
+	case StartEmbed:
+		sync->depth++;
+		break;
+	case EndToRecip:
+	case EndAttach:
+	case EndEmbed:
+		if (sync->depth) sync->depth--;
+		break;
+	case IncrSyncMessage:
+		break;
+	case IncrSyncStateBegin:
+		sync->in_state = true;
+		sync->current = -1;
+		break;
+	case IncrSyncStateEnd:
+		sync->in_state = false;
+		break;
+	default:
+		sync->current = -1;
+		break;
+	}
+	sync->marker = marker;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static enum MAPISTATUS mapi_cache_sync_property(struct SPropValue prop, void *priv)
+{
+	struct mapi_cache_sync	*sync = (struct mapi_cache_sync *) priv;
+	struct mapi_cache_item	*item;
+	enum mapi_cache_action	action;
+	struct idset		*idset;
+	DATA_BLOB		blob;
+
+	if (sync->in_state) {
+		return mapi_cache_row_set(sync->mem_ctx, &sync->state, &prop);
+	}
+
+	switch (sync->marker) {
+	case IncrSyncDel:
+		if (prop.ulPropTag != MetaTagIdsetDeleted && prop.ulPropTag != MetaTagIdsetNoLongerInScope &&
+		    prop.ulPropTag != MetaTagIdsetExpired) {
+			return MAPI_E_SUCCESS;
+		}
+		action = MAPI_CACHE_DELETE;
+		break;
+	case IncrSyncRead:
+		if (prop.ulPropTag == MetaTagIdsetRead) {
+			action = MAPI_CACHE_READ;
+		} else if (prop.ulPropTag == MetaTagIdsetUnread) {
+			action = MAPI_CACHE_UNREAD;
+		} else {
+			return MAPI_E_SUCCESS;
+		}
+		break;
+	default:
+		if (sync->current < 0 || sync->depth) return MAPI_E_SUCCESS;
+
+		item = &sync->items[sync->current];
+		if (prop.ulPropTag == (sync->type == Hierarchy ? PR_FID : PR_MID)) {
+			item->id = prop.value.d;
+		}
+		if (!mapi_cache_storable(prop.ulPropTag)) return MAPI_E_SUCCESS;
+		return mapi_cache_row_set(sync->mem_ctx, &item->row, &prop);
+	}
+
+	blob.data = prop.value.bin.lpb;
+	blob.length = prop.value.bin.cb;
+	idset = IDSET_parse(sync->mem_ctx, blob, true);
+	OPENCHANGE_RETVAL_IF(!idset, MAPI_E_CORRUPT_DATA, NULL);
+
+	sync->idsets = talloc_realloc(sync->mem_ctx, sync->idsets, struct mapi_cache_idset, sync->idsets_count + 1);
+	OPENCHANGE_RETVAL_IF(!sync->idsets, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	sync->idsets[sync->idsets_count].action = action;
+	sync->idsets[sync->idsets_count].idset = idset;
+	sync->idsets_count++;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Store a changed folder or message, merged with the cached
+   properties when the change is partial
+ */
+static enum MAPISTATUS mapi_cache_store_item(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+					     const char *key, struct mapi_cache_item *item)
+{
+	enum MAPISTATUS	retval;
+	struct SRow	row;
+	uint32_t	i;
+
+	if (!item->partial || mapi_cache_fetch_row(cache, mem_ctx, key, &row) != MAPI_E_SUCCESS) {
+		return mapi_cache_store_row(cache, key, item->row.cValues, item->row.lpProps);
+	}
+
+	for (i = 0; i < item->row.cValues; i++) {
+		retval = mapi_cache_row_set(mem_ctx, &row, &item->row.lpProps[i]);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	return mapi_cache_store_row(cache, key, row.cValues, row.lpProps);
+}
+
+
+static bool mapi_cache_idsets_include(struct mapi_cache_sync *sync, enum mapi_cache_action action, uint64_t id)
+{
+	uint32_t	i;
+
+	for (i = 0; i < sync->idsets_count; i++) {
+		if (sync->idsets[i].action == action && IDSET_includes_eid(sync->idsets[i].idset, id)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+   \details Remove a folder, its messages and its states from the cache
+ */
+static enum MAPISTATUS mapi_cache_remove_folder(struct mapi_cache *cache, TALLOC_CTX *mem_ctx, uint64_t fid)
+{
+	enum MAPISTATUS	retval;
+	uint64_t	*mids;
+	uint32_t	count;
+	uint32_t	i;
+
+	retval = mapi_cache_fetch_contents(cache, mem_ctx, fid, &mids, &count);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	for (i = 0; i < count; i++) {
+		tdb_delete(cache->tdb, mapi_cache_key(talloc_asprintf(mem_ctx, "message/%016"PRIx64"/%016"PRIx64, fid, mids[i])));
+	}
+
+	tdb_delete(cache->tdb, mapi_cache_key(talloc_asprintf(mem_ctx, "contents/%016"PRIx64, fid)));
+	tdb_delete(cache->tdb, mapi_cache_key(talloc_asprintf(mem_ctx, "state/contents/%016"PRIx64, fid)));
+	tdb_delete(cache->tdb, mapi_cache_key(talloc_asprintf(mem_ctx, "state/hierarchy/%016"PRIx64, fid)));
+	tdb_delete(cache->tdb, mapi_cache_key(talloc_asprintf(mem_ctx, "folder/%016"PRIx64, fid)));
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static bool mapi_cache_same_source_key(struct SRow *row, struct SPropValue *source_key)
+{
+	struct SPropValue	*lpProp;
+
+	lpProp = get_SPropValue_SRow(row, PR_SOURCE_KEY);
+	return lpProp && lpProp->value.bin.cb == source_key->value.bin.cb &&
+		!memcmp(lpProp->value.bin.lpb, source_key->value.bin.lpb, source_key->value.bin.cb);
+}
+
+
+/**
+   \details Give a changed folder its parent folder identifier when the
+   server only sent its parent source key
+
+   The parent is the synchronized folder when the parent source key is
+   empty, otherwise it is looked up among the folders of the
+   synchronization and then among the cached folders.
+ */
+static enum MAPISTATUS mapi_cache_set_parent_fid(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						 struct mapi_cache_sync *sync, uint64_t fid,
+						 struct mapi_cache_item *item)
+{
+	struct SPropValue	*source_key;
+	struct SPropValue	parent;
+	struct mapi_cache_ids	fids;
+	struct SRow		row;
+	uint32_t		i;
+
+	if (get_SPropValue_SRow(&item->row, PR_PARENT_FID)) return MAPI_E_SUCCESS;
+
+	parent.ulPropTag = PR_PARENT_FID;
+	parent.dwAlignPad = 0;
+	parent.value.d = 0;
+
+	source_key = get_SPropValue_SRow(&item->row, PR_PARENT_SOURCE_KEY);
+	if (!source_key || !source_key->value.bin.cb) {
+		parent.value.d = fid;
+	}
+
+	for (i = 0; !parent.value.d && i < sync->items_count; i++) {
+		if (mapi_cache_same_source_key(&sync->items[i].row, source_key)) {
+			parent.value.d = sync->items[i].id;
+		}
+	}
+
+	if (!parent.value.d) {
+		memset(&fids, 0, sizeof (fids));
+		fids.mem_ctx = mem_ctx;
+		OPENCHANGE_RETVAL_IF(tdb_traverse(cache->tdb, mapi_cache_traverse_folders, &fids) < 0,
+				     MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		for (i = 0; !parent.value.d && i < fids.count; i++) {
+			if (mapi_cache_get_folder(cache, mem_ctx, fids.ids[i], &row) != MAPI_E_SUCCESS) continue;
+			if (mapi_cache_same_source_key(&row, source_key)) {
+				parent.value.d = fids.ids[i];
+			}
+		}
+	}
+
+	if (!parent.value.d) return MAPI_E_SUCCESS;
+
+	return mapi_cache_row_set(sync->mem_ctx, &item->row, &parent);
+}
+
+
+static enum MAPISTATUS mapi_cache_apply_hierarchy(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						  struct mapi_cache_sync *sync, uint64_t fid)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_cache_ids	fids;
+	uint32_t		i;
+
+	for (i = 0; i < sync->items_count; i++) {
+		if (!sync->items[i].id) continue;
+		retval = mapi_cache_set_parent_fid(cache, mem_ctx, sync, fid, &sync->items[i]);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		retval = mapi_cache_store_item(cache, mem_ctx, talloc_asprintf(mem_ctx, "folder/%016"PRIx64, sync->items[i].id),
+					       &sync->items[i]);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	if (!sync->idsets_count) return MAPI_E_SUCCESS;
+
+	memset(&fids, 0, sizeof (fids));
+	fids.mem_ctx = mem_ctx;
+	OPENCHANGE_RETVAL_IF(tdb_traverse(cache->tdb, mapi_cache_traverse_folders, &fids) < 0,
+			     MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	for (i = 0; i < fids.count; i++) {
+		if (!mapi_cache_idsets_include(sync, MAPI_CACHE_DELETE, fids.ids[i])) continue;
+		retval = mapi_cache_remove_folder(cache, mem_ctx, fids.ids[i]);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static enum MAPISTATUS mapi_cache_apply_contents(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						 struct mapi_cache_sync *sync, uint64_t fid)
+{
+	enum MAPISTATUS		retval;
+	struct SPropValue	*lpProp;
+	struct SPropValue	flags;
+	struct SRow		row;
+	TDB_DATA		dbuf;
+	uint64_t		*mids;
+	uint32_t		count;
+	uint32_t		known;
+	uint32_t		i;
+	uint32_t		j;
+	char			*key;
+
+	/* The index is kept sorted */
+	retval = mapi_cache_fetch_contents(cache, mem_ctx, fid, &mids, &count);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	known = count;
+
+	for (i = 0; i < sync->items_count; i++) {
+		if (!sync->items[i].id) continue;
+		key = talloc_asprintf(mem_ctx, "message/%016"PRIx64"/%016"PRIx64, fid, sync->items[i].id);
+		retval = mapi_cache_store_item(cache, mem_ctx, key, &sync->items[i]);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+		if (known && bsearch(&sync->items[i].id, mids, known, sizeof (uint64_t), mapi_cache_compare_ids)) continue;
+		mids = talloc_realloc(mem_ctx, mids, uint64_t, count + 1);
+		OPENCHANGE_RETVAL_IF(!mids, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		mids[count++] = sync->items[i].id;
+	}
+
+	for (i = 0, j = 0; sync->idsets_count && i < count; i++) {
+		key = talloc_asprintf(mem_ctx, "message/%016"PRIx64"/%016"PRIx64, fid, mids[i]);
+		OPENCHANGE_RETVAL_IF(!key, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+		if (mapi_cache_idsets_include(sync, MAPI_CACHE_DELETE, mids[i])) {
+			tdb_delete(cache->tdb, mapi_cache_key(key));
+			talloc_free(key);
+			continue;
+		}
+		mids[j++] = mids[i];
+
+		if (mapi_cache_idsets_include(sync, MAPI_CACHE_READ, mids[i])) {
+			flags.value.l = MSGFLAG_READ;
+		} else if (mapi_cache_idsets_include(sync, MAPI_CACHE_UNREAD, mids[i])) {
+			flags.value.l = 0;
+		} else {
+			talloc_free(key);
+			continue;
+		}
+		if (mapi_cache_fetch_row(cache, mem_ctx, key, &row) != MAPI_E_SUCCESS) {
+			talloc_free(key);
+			continue;
+		}
+
+		flags.ulPropTag = PR_MESSAGE_FLAGS;
+		flags.dwAlignPad = 0;
+		lpProp = get_SPropValue_SRow(&row, PR_MESSAGE_FLAGS);
+		if (lpProp) {
+			flags.value.l |= lpProp->value.l & ~MSGFLAG_READ;
+		}
+		retval = mapi_cache_row_set(mem_ctx, &row, &flags);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		retval = mapi_cache_store_row(cache, key, row.cValues, row.lpProps);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		talloc_free(row.lpProps);
+		talloc_free(key);
+	}
+	if (sync->idsets_count) {
+		count = j;
+	}
+
+	key = talloc_asprintf(mem_ctx, "contents/%016"PRIx64, fid);
+	OPENCHANGE_RETVAL_IF(!key, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	if (!count) {
+		tdb_delete(cache->tdb, mapi_cache_key(key));
+		return MAPI_E_SUCCESS;
+	}
+
+	qsort(mids, count, sizeof (uint64_t), mapi_cache_compare_ids);
+	dbuf.dptr = (unsigned char *) mids;
+	dbuf.dsize = count * sizeof (uint64_t);
+	OPENCHANGE_RETVAL_IF(tdb_store(cache->tdb, mapi_cache_key(key), dbuf, TDB_REPLACE), MAPI_E_DISK_ERROR, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Store the changes and the state received by a
+   synchronization of a folder, in a single transaction
+ */
+enum MAPISTATUS mapi_cache_apply(struct mapi_cache *cache, struct mapi_cache_sync *sync, uint64_t fid)
+{
+	enum MAPISTATUS	retval;
+	TALLOC_CTX	*mem_ctx;
+	char		*key;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	OPENCHANGE_RETVAL_IF(tdb_transaction_start(cache->tdb), MAPI_E_DISK_ERROR, mem_ctx);
+
+	if (sync->type == Hierarchy) {
+		retval = mapi_cache_apply_hierarchy(cache, mem_ctx, sync, fid);
+	} else {
+		retval = mapi_cache_apply_contents(cache, mem_ctx, sync, fid);
+	}
+
+	if (retval == MAPI_E_SUCCESS && sync->state.cValues) {
+		key = talloc_asprintf(mem_ctx, "state/%s/%016"PRIx64,
+				      sync->type == Hierarchy ? "hierarchy" : "contents", fid);
+		retval = mapi_cache_store_row(cache, key, sync->state.cValues, sync->state.lpProps);
+	}
+
+	if (retval != MAPI_E_SUCCESS) {
+		tdb_transaction_cancel(cache->tdb);
+		OPENCHANGE_RETVAL_ERR(retval, mem_ctx);
+	}
+	OPENCHANGE_RETVAL_IF(tdb_transaction_commit(cache->tdb), MAPI_E_DISK_ERROR, mem_ctx);
+
+	talloc_free(mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Prepare the reception of a synchronization stream
+
+   \param mem_ctx pointer to the memory context
+   \param type the type of synchronization
+   \param parserp pointer on pointer to the parser the stream is fed to
+
+   \return the synchronization on success, otherwise NULL
+ */
+struct mapi_cache_sync *mapi_cache_sync_init(TALLOC_CTX *mem_ctx, enum SynchronizationType type,
+					     struct fx_parser_context **parserp)
+{
+	struct mapi_cache_sync	*sync;
+
+	sync = talloc_zero(mem_ctx, struct mapi_cache_sync);
+	if (!sync) return NULL;
+	sync->mem_ctx = sync;
+	sync->type = type;
+	sync->current = -1;
+
+	*parserp = fxparser_init(sync, sync);
+	if (!*parserp) {
+		talloc_free(sync);
+		return NULL;
+	}
+	fxparser_set_marker_callback(*parserp, mapi_cache_sync_marker);
+	fxparser_set_property_callback(*parserp, mapi_cache_sync_property);
+
+	return sync;
+}
+
+
+static enum MAPISTATUS mapi_cache_upload_state(mapi_object_t *obj_sync, struct SPropValue *lpProp)
+{
+	enum MAPISTATUS	retval;
+	DATA_BLOB	chunk;
+	uint32_t	proptag;
+	uint32_t	offset;
+
+	if ((lpProp->ulPropTag & 0xFFFF) != PT_BINARY) return MAPI_E_SUCCESS;
+
+	/* MetaTagIdsetGiven is reported by the parser with a PT_BINARY
+	   type */
+	proptag = lpProp->ulPropTag;
+	if ((proptag & 0xFFFF0000) == (MetaTagIdsetGiven & 0xFFFF0000)) {
+		proptag = MetaTagIdsetGiven;
+	}
+
+	retval = ICSSyncUploadStateBegin(obj_sync, (enum StateProperty) proptag, lpProp->value.bin.cb);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	for (offset = 0; offset < lpProp->value.bin.cb; offset += chunk.length) {
+		chunk.data = lpProp->value.bin.lpb + offset;
+		chunk.length = MIN(MAPI_CACHE_STATE_CHUNK, lpProp->value.bin.cb - offset);
+		retval = ICSSyncUploadStateContinue(obj_sync, chunk);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	return ICSSyncUploadStateEnd(obj_sync);
+}
+
+
+static enum MAPISTATUS mapi_cache_sync_folder(struct mapi_cache *cache, mapi_object_t *obj_folder,
+					      enum SynchronizationType type)
+{
+	enum MAPISTATUS			retval;
+	TALLOC_CTX			*mem_ctx;
+	struct mapi_cache_sync		*sync;
+	struct fx_parser_context	*parser;
+	struct SPropTagArray		*SPropTagArray;
+	mapi_object_t			obj_sync;
+	enum TransferStatus		status;
+	struct SRow			state;
+	uint16_t			progress;
+	uint16_t			total;
+	uint16_t			flags;
+	uint32_t			extra_flags;
+	DATA_BLOB			buffer;
+	uint64_t			fid;
+	uint32_t			i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!cache, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!obj_folder, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_named(NULL, 0, "mapi_cache_sync_folder");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	fid = mapi_object_get_id(obj_folder);
+
+	sync = mapi_cache_sync_init(mem_ctx, type, &parser);
+	OPENCHANGE_RETVAL_IF(!sync, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	if (type == Contents) {
+		/* Only the cached columns are transferred, the message
+		   identifiers come with the change headers */
+		SPropTagArray = cache->columns;
+		flags = SynchronizationFlag_Unicode | SynchronizationFlag_ReadState |
+			SynchronizationFlag_Normal | SynchronizationFlag_OnlySpecifiedProperties;
+		extra_flags = Eid | MessageSize | Cn;
+	} else {
+		/* No property excluded */
+		SPropTagArray = talloc_zero(mem_ctx, struct SPropTagArray);
+		OPENCHANGE_RETVAL_IF(!SPropTagArray, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+		SPropTagArray->aulPropTag = talloc_zero(SPropTagArray, enum MAPITAGS);
+		flags = SynchronizationFlag_Unicode;
+		extra_flags = Eid | Cn;
+	}
+
+	mapi_object_init(&obj_sync);
+	retval = ICSSyncConfigure(obj_folder, type, FastTransfer_Unicode, flags, extra_flags,
+				  data_blob_null, SPropTagArray, &obj_sync);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	if (mapi_cache_fetch_row(cache, mem_ctx, talloc_asprintf(mem_ctx, "state/%s/%016"PRIx64,
+								 type == Hierarchy ? "hierarchy" : "contents", fid),
+				 &state) == MAPI_E_SUCCESS) {
+		for (i = 0; i < state.cValues; i++) {
+			retval = mapi_cache_upload_state(&obj_sync, &state.lpProps[i]);
+			if (retval != MAPI_E_SUCCESS) goto end;
+		}
+	}
+
+	do {
+		retval = FXGetBuffer(&obj_sync, 0, &status, &progress, &total, &buffer);
+		if (retval != MAPI_E_SUCCESS) goto end;
+		if (status == TransferStatus_Error) {
+			talloc_free(buffer.data);
+			retval = MAPI_E_CALL_FAILED;
+			goto end;
+		}
+		retval = fxparser_parse(parser, &buffer);
+		talloc_free(buffer.data);
+		if (retval != MAPI_E_SUCCESS) goto end;
+	} while (status != TransferStatus_Done);
+
+	retval = mapi_cache_apply(cache, sync, fid);
+
+end:
+	mapi_object_release(&obj_sync);
+	talloc_free(mem_ctx);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Synchronize the cached subfolders of a folder
+
+   Folders created or changed since the last synchronization of the
+   folder are stored in the cache, deleted folders are removed with
+   their messages.
+
+   \param cache pointer to the cache
+   \param obj_folder the folder whose hierarchy is synchronized
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_sync_hierarchy(struct mapi_cache *cache, mapi_object_t *obj_folder)
+{
+	return mapi_cache_sync_folder(cache, obj_folder, Hierarchy);
+}
+
+
+/**
+   \details Synchronize the cached messages of a folder
+
+   The columns of the messages created or changed since the last
+   synchronization of the folder are stored in the cache, deleted
+   messages are removed and the read flag of the others is updated.
+
+   \param cache pointer to the cache
+   \param obj_folder the folder whose contents is synchronized
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_sync_contents(struct mapi_cache *cache, mapi_object_t *obj_folder)
+{
+	return mapi_cache_sync_folder(cache, obj_folder, Contents);
+}
+
+
+/**
+   \details Retrieve the cached properties of a folder
+
+   \param cache pointer to the cache
+   \param mem_ctx pointer to the memory context
+   \param fid the folder identifier
+   \param row pointer to the row to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if the folder
+   isn't cached, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_get_folder(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+					       uint64_t fid, struct SRow *row)
+{
+	enum MAPISTATUS	retval;
+	char		*key;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!cache || !row, MAPI_E_INVALID_PARAMETER, NULL);
+
+	key = talloc_asprintf(mem_ctx, "folder/%016"PRIx64, fid);
+	OPENCHANGE_RETVAL_IF(!key, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	retval = mapi_cache_fetch_row(cache, mem_ctx, key, row);
+	talloc_free(key);
+
+	return retval;
+}
+
+
+/**
+   \details Retrieve the cached subfolders of a folder
+
+   \param cache pointer to the cache
+   \param mem_ctx pointer to the memory context
+   \param fid the parent folder identifier
+   \param rowset pointer to the rows to return, one per subfolder
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_get_hierarchy(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						  uint64_t fid, struct SRowSet *rowset)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_cache_ids	fids;
+	struct SPropValue	*lpProp;
+	struct SRow		row;
+	uint32_t		i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!cache || !rowset, MAPI_E_INVALID_PARAMETER, NULL);
+
+	memset(&fids, 0, sizeof (fids));
+	fids.mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!fids.mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	OPENCHANGE_RETVAL_IF(tdb_traverse_read(cache->tdb, mapi_cache_traverse_folders, &fids) < 0,
+			     MAPI_E_NOT_ENOUGH_MEMORY, fids.mem_ctx);
+
+	rowset->cRows = 0;
+	rowset->aRow = talloc_array(mem_ctx, struct SRow, fids.count + 1);
+	OPENCHANGE_RETVAL_IF(!rowset->aRow, MAPI_E_NOT_ENOUGH_MEMORY, fids.mem_ctx);
+
+	for (i = 0; i < fids.count; i++) {
+		retval = mapi_cache_get_folder(cache, rowset->aRow, fids.ids[i], &row);
+		if (retval != MAPI_E_SUCCESS) continue;
+
+		lpProp = get_SPropValue_SRow(&row, PR_PARENT_FID);
+		if (!lpProp || lpProp->value.d != fid) {
+			talloc_free(row.lpProps);
+			continue;
+		}
+		rowset->aRow[rowset->cRows++] = row;
+	}
+
+	talloc_free(fids.mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the cached messages of a folder
+
+   The rows hold the cached columns and the message identifier, in the
+   order of the message identifiers.
+
+   \param cache pointer to the cache
+   \param mem_ctx pointer to the memory context
+   \param fid the folder identifier
+   \param rowset pointer to the rows to return, one per message
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_get_contents(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						 uint64_t fid, struct SRowSet *rowset)
+{
+	enum MAPISTATUS	retval;
+	TALLOC_CTX	*local_mem_ctx;
+	uint64_t	*mids;
+	uint32_t	count;
+	uint32_t	i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!cache || !rowset, MAPI_E_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	retval = mapi_cache_fetch_contents(cache, local_mem_ctx, fid, &mids, &count);
+	OPENCHANGE_RETVAL_IF(retval, retval, local_mem_ctx);
+
+	rowset->cRows = 0;
+	rowset->aRow = talloc_array(mem_ctx, struct SRow, count + 1);
+	OPENCHANGE_RETVAL_IF(!rowset->aRow, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+
+	for (i = 0; i < count; i++) {
+		retval = mapi_cache_get_message(cache, rowset->aRow, fid, mids[i], &rowset->aRow[rowset->cRows]);
+		if (retval == MAPI_E_SUCCESS) {
+			rowset->cRows++;
+		}
+	}
+
+	talloc_free(local_mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the cached columns of a message
+
+   \param cache pointer to the cache
+   \param mem_ctx pointer to the memory context
+   \param fid the folder identifier
+   \param mid the message identifier
+   \param row pointer to the row to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if the message
+   isn't cached, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS mapi_cache_get_message(struct mapi_cache *cache, TALLOC_CTX *mem_ctx,
+						uint64_t fid, uint64_t mid, struct SRow *row)
+{
+	enum MAPISTATUS	retval;
+	char		*key;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!cache || !row, MAPI_E_INVALID_PARAMETER, NULL);
+
+	key = talloc_asprintf(mem_ctx, "message/%016"PRIx64"/%016"PRIx64, fid, mid);
+	OPENCHANGE_RETVAL_IF(!key, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	retval = mapi_cache_fetch_row(cache, mem_ctx, key, row);
+	talloc_free(key);
+
+	return retval;
+}
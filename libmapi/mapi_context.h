@@ -26,6 +26,9 @@
 
 struct ldb_context;
 struct mapi_session;
+struct mapi_profile_cache;
+struct mapi_connection;
+struct tevent_context;
 
 struct mapi_context
 {
@@ -34,6 +37,16 @@ struct mapi_context
   struct mapi_session	*session;
   bool			dumpdata;
   struct loadparm_context *lp_ctx;
+  uint32_t		max_response_size;	/* pcbOut of EcDoRpcExt2 calls */
+  bool			compression;		/* ask for compressed responses */
+  const char		*profiledb;
+  bool			profiledb_readonly;
+  struct mapi_profile_cache *profile_cache;
+  uint32_t		profile_cache_ttl;	/* seconds, 0 disables the cache */
+  bool			connection_pool;	/* share connections between sessions */
+  uint32_t		connection_idle_timeout;
+  struct mapi_connection *connections;
+  struct tevent_context	*ev;			/* shared by new connections when set */
 };
 
 
@@ -30,6 +30,159 @@
 */
 
 
+#define	MAPI_NAMEID_INDEX_COUNT(index) (sizeof (index) / sizeof (index[0]))
+
+typedef int (*mapi_nameid_index_cmp_t)(uint16_t, const void *);
+
+/**
+   \details Return the position in index of the first entry which
+   does not compare lower than key
+ */
+static uint32_t mapi_nameid_index_lower_bound(const uint16_t *index, uint32_t count,
+					      mapi_nameid_index_cmp_t cmp, const void *key)
+{
+	uint32_t	low = 0;
+	uint32_t	high = count;
+	uint32_t	mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (cmp(index[mid], key) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+static int mapi_nameid_tags_proptag_cmp(uint16_t idx, const void *key)
+{
+	uint32_t	proptag = *(const uint32_t *)key;
+
+	if (mapi_nameid_tags[idx].proptag == proptag) return 0;
+	return (mapi_nameid_tags[idx].proptag < proptag) ? -1 : 1;
+}
+
+static int mapi_nameid_tags_lid_cmp(uint16_t idx, const void *key)
+{
+	return (int)mapi_nameid_tags[idx].lid - (int)*(const uint16_t *)key;
+}
+
+static int mapi_nameid_tags_OOM_cmp(uint16_t idx, const void *key)
+{
+	return strcmp(mapi_nameid_tags[idx].OOM, (const char *)key);
+}
+
+static int mapi_nameid_tags_Name_cmp(uint16_t idx, const void *key)
+{
+	return strcmp(mapi_nameid_tags[idx].Name, (const char *)key);
+}
+
+static int mapi_nameid_names_proptag_cmp(uint16_t idx, const void *key)
+{
+	uint32_t	proptag = *(const uint32_t *)key;
+
+	if (mapi_nameid_names[idx].proptag == proptag) return 0;
+	return (mapi_nameid_names[idx].proptag < proptag) ? -1 : 1;
+}
+
+static int mapi_nameid_names_propname_cmp(uint16_t idx, const void *key)
+{
+	return strcmp(mapi_nameid_names[idx].propname, (const char *)key);
+}
+
+/**
+   \details Search one of the mapi_nameid_tags indexes for key and
+   return the first matching entry belonging to OLEGUID, in
+   mapi_nameid_tags order
+
+   \param index the index to search
+   \param count number of elements in index
+   \param cmp function comparing an entry with key
+   \param key the key to search
+   \param OLEGUID the property set the entry belongs to, NULL matches
+   any property set
+
+   \return pointer on the entry on success, otherwise NULL
+ */
+static const struct mapi_nameid_tags *mapi_nameid_tags_find(const uint16_t *index, uint32_t count,
+							    mapi_nameid_index_cmp_t cmp, const void *key,
+							    const char *OLEGUID)
+{
+	uint32_t	pos;
+
+	for (pos = mapi_nameid_index_lower_bound(index, count, cmp, key);
+	     pos < count && !cmp(index[pos], key); pos++) {
+		if (!OLEGUID || !strcmp(mapi_nameid_tags[index[pos]].OLEGUID, OLEGUID)) {
+			return &mapi_nameid_tags[index[pos]];
+		}
+	}
+
+	return NULL;
+}
+
+#define	mapi_nameid_tags_find_proptag(proptag)				\
+	mapi_nameid_tags_find(mapi_nameid_tags_by_proptag,		\
+			      MAPI_NAMEID_INDEX_COUNT(mapi_nameid_tags_by_proptag), \
+			      mapi_nameid_tags_proptag_cmp, &(proptag), NULL)
+#define	mapi_nameid_tags_find_lid(lid, OLEGUID)				\
+	mapi_nameid_tags_find(mapi_nameid_tags_by_lid,			\
+			      MAPI_NAMEID_INDEX_COUNT(mapi_nameid_tags_by_lid), \
+			      mapi_nameid_tags_lid_cmp, &(lid), OLEGUID)
+#define	mapi_nameid_tags_find_OOM(OOM, OLEGUID)				\
+	mapi_nameid_tags_find(mapi_nameid_tags_by_OOM,			\
+			      MAPI_NAMEID_INDEX_COUNT(mapi_nameid_tags_by_OOM), \
+			      mapi_nameid_tags_OOM_cmp, OOM, OLEGUID)
+#define	mapi_nameid_tags_find_Name(Name, OLEGUID)			\
+	mapi_nameid_tags_find(mapi_nameid_tags_by_Name,			\
+			      MAPI_NAMEID_INDEX_COUNT(mapi_nameid_tags_by_Name), \
+			      mapi_nameid_tags_Name_cmp, Name, OLEGUID)
+
+
+/**
+   \details Append a copy of a known named property entry to a
+   mapi_nameid structure
+
+   \param mapi_nameid the structure where results are stored
+   \param entry the mapi_nameid_tags entry to add
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+static enum MAPISTATUS mapi_nameid_entry_add(struct mapi_nameid *mapi_nameid,
+					     const struct mapi_nameid_tags *entry)
+{
+	uint16_t	count;
+
+	mapi_nameid->nameid = talloc_realloc(mapi_nameid,
+					     mapi_nameid->nameid, struct MAPINAMEID,
+					     mapi_nameid->count + 1);
+	mapi_nameid->entries = talloc_realloc(mapi_nameid,
+					      mapi_nameid->entries, struct mapi_nameid_tags,
+					      mapi_nameid->count + 1);
+	OPENCHANGE_RETVAL_IF(!mapi_nameid->nameid || !mapi_nameid->entries, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	count = mapi_nameid->count;
+
+	mapi_nameid->entries[count] = *entry;
+
+	mapi_nameid->nameid[count].ulKind = (enum ulKind) entry->ulKind;
+	GUID_from_string(entry->OLEGUID, &(mapi_nameid->nameid[count].lpguid));
+	switch (entry->ulKind) {
+	case MNID_ID:
+		mapi_nameid->nameid[count].kind.lid = entry->lid;
+		break;
+	case MNID_STRING:
+		mapi_nameid->nameid[count].kind.lpwstr.Name = entry->Name;
+		mapi_nameid->nameid[count].kind.lpwstr.NameSize = get_utf8_utf16_conv_length(entry->Name);
+		break;
+	}
+	mapi_nameid->count++;
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Create a new mapi_nameid structure
 
@@ -81,46 +234,17 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_OOM_add(struct mapi_nameid *mapi_nameid,
 					     const char *OOM,
 					     const char *OLEGUID)
 {
-	uint32_t		i;
-	uint16_t		count;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity check */
 	OPENCHANGE_RETVAL_IF(!mapi_nameid, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(!OOM, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].OOM &&
-		    !strcmp(OOM, mapi_nameid_tags[i].OOM) &&
-		    !strcmp(OLEGUID, mapi_nameid_tags[i].OLEGUID)) {
-			mapi_nameid->nameid = talloc_realloc(mapi_nameid,
-							     mapi_nameid->nameid, struct MAPINAMEID,
-							     mapi_nameid->count + 1);
-			mapi_nameid->entries = talloc_realloc(mapi_nameid,
-							    mapi_nameid->entries, struct mapi_nameid_tags,
-							    mapi_nameid->count + 1);
-			count = mapi_nameid->count;
-
-			mapi_nameid->entries[count] = mapi_nameid_tags[i];
-
-			mapi_nameid->nameid[count].ulKind = (enum ulKind)mapi_nameid_tags[i].ulKind;
-			GUID_from_string(mapi_nameid_tags[i].OLEGUID,
-					 &(mapi_nameid->nameid[count].lpguid));
-			switch (mapi_nameid_tags[i].ulKind) {
-			case MNID_ID:
-				mapi_nameid->nameid[count].kind.lid = mapi_nameid_tags[i].lid;
-				break;
-			case MNID_STRING:
-				mapi_nameid->nameid[count].kind.lpwstr.Name = mapi_nameid_tags[i].Name;
-				mapi_nameid->nameid[count].kind.lpwstr.NameSize = get_utf8_utf16_conv_length(mapi_nameid_tags[i].Name);
-				break;
-			}
-			mapi_nameid->count++;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_OOM(OOM, OLEGUID);
+	if (!entry) return MAPI_E_NOT_FOUND;
 
-	return MAPI_E_NOT_FOUND;
+	return mapi_nameid_entry_add(mapi_nameid, entry);
 }
 
 
@@ -147,45 +271,17 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_OOM_add(struct mapi_nameid *mapi_nameid,
 _PUBLIC_ enum MAPISTATUS mapi_nameid_lid_add(struct mapi_nameid *mapi_nameid,
 					     uint16_t lid, const char *OLEGUID)
 {
-	uint32_t		i;
-	uint16_t		count;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity check */
 	OPENCHANGE_RETVAL_IF(!mapi_nameid, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(!lid, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if ((lid == mapi_nameid_tags[i].lid) &&
-		    !strcmp(OLEGUID, mapi_nameid_tags[i].OLEGUID)) {
-			mapi_nameid->nameid = talloc_realloc(mapi_nameid,
-							     mapi_nameid->nameid, struct MAPINAMEID,
-							     mapi_nameid->count + 1);
-			mapi_nameid->entries = talloc_realloc(mapi_nameid,
-							    mapi_nameid->entries, struct mapi_nameid_tags,
-							    mapi_nameid->count + 1);
-			count = mapi_nameid->count;
-
-			mapi_nameid->entries[count] = mapi_nameid_tags[i];
-
-			mapi_nameid->nameid[count].ulKind = (enum ulKind) mapi_nameid_tags[i].ulKind;
-			GUID_from_string(mapi_nameid_tags[i].OLEGUID,
-					 &(mapi_nameid->nameid[count].lpguid));
-			switch (mapi_nameid_tags[i].ulKind) {
-			case MNID_ID:
-				mapi_nameid->nameid[count].kind.lid = mapi_nameid_tags[i].lid;
-				break;
-			case MNID_STRING:
-				mapi_nameid->nameid[count].kind.lpwstr.Name = mapi_nameid_tags[i].Name;
-				mapi_nameid->nameid[count].kind.lpwstr.NameSize = get_utf8_utf16_conv_length(mapi_nameid_tags[i].Name);
-				break;
-			}
-			mapi_nameid->count++;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_lid(lid, OLEGUID);
+	if (!entry) return MAPI_E_NOT_FOUND;
 
-	return MAPI_E_NOT_FOUND;
+	return mapi_nameid_entry_add(mapi_nameid, entry);
 }
 
 
@@ -213,46 +309,17 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_string_add(struct mapi_nameid *mapi_nameid,
 						const char *Name,
 						const char *OLEGUID)
 {
-	uint32_t		i;
-	uint16_t		count;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity check */
 	OPENCHANGE_RETVAL_IF(!mapi_nameid, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(!Name, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].Name &&
-		    !strcmp(Name, mapi_nameid_tags[i].Name) &&
-		    !strcmp(OLEGUID, mapi_nameid_tags[i].OLEGUID)) {
-			mapi_nameid->nameid = talloc_realloc(mapi_nameid,
-							     mapi_nameid->nameid, struct MAPINAMEID,
-							     mapi_nameid->count + 1);
-			mapi_nameid->entries = talloc_realloc(mapi_nameid,
-							    mapi_nameid->entries, struct mapi_nameid_tags,
-							    mapi_nameid->count + 1);
-			count = mapi_nameid->count;
-
-			mapi_nameid->entries[count] = mapi_nameid_tags[i];
-
-			mapi_nameid->nameid[count].ulKind = (enum ulKind) mapi_nameid_tags[i].ulKind;
-			GUID_from_string(mapi_nameid_tags[i].OLEGUID,
-					 &(mapi_nameid->nameid[count].lpguid));
-			switch (mapi_nameid_tags[i].ulKind) {
-			case MNID_ID:
-				mapi_nameid->nameid[count].kind.lid = mapi_nameid_tags[i].lid;
-				break;
-			case MNID_STRING:
-				mapi_nameid->nameid[count].kind.lpwstr.Name = mapi_nameid_tags[i].Name;
-				mapi_nameid->nameid[count].kind.lpwstr.NameSize = get_utf8_utf16_conv_length(mapi_nameid_tags[i].Name);
-				break;
-			}
-			mapi_nameid->count++;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_Name(Name, OLEGUID);
+	if (!entry) return MAPI_E_NOT_FOUND;
 
-	return MAPI_E_NOT_FOUND;
+	return mapi_nameid_entry_add(mapi_nameid, entry);
 }
 
 /**
@@ -380,43 +447,16 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_custom_string_add(struct mapi_nameid *mapi_
 _PUBLIC_ enum MAPISTATUS mapi_nameid_canonical_add(struct mapi_nameid *mapi_nameid,
 						   uint32_t proptag)
 {
-	uint32_t	i;
-	uint16_t	count;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!mapi_nameid, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(!proptag, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].proptag == proptag) {
-			mapi_nameid->nameid = talloc_realloc(mapi_nameid,
-							     mapi_nameid->nameid, struct MAPINAMEID,
-							     mapi_nameid->count + 1);
-			mapi_nameid->entries = talloc_realloc(mapi_nameid,
-							      mapi_nameid->entries, struct mapi_nameid_tags,
-							      mapi_nameid->count + 1);
-			count = mapi_nameid->count;
-
-			mapi_nameid->entries[count] = mapi_nameid_tags[i];
-
-			mapi_nameid->nameid[count].ulKind = (enum ulKind) mapi_nameid_tags[i].ulKind;
-			GUID_from_string(mapi_nameid_tags[i].OLEGUID,
-					 &(mapi_nameid->nameid[count].lpguid));
-			switch (mapi_nameid_tags[i].ulKind) {
-			case MNID_ID:
-				mapi_nameid->nameid[count].kind.lid = mapi_nameid_tags[i].lid;
-				break;
-			case MNID_STRING:
-				mapi_nameid->nameid[count].kind.lpwstr.Name = mapi_nameid_tags[i].Name;
-				mapi_nameid->nameid[count].kind.lpwstr.NameSize = get_utf8_utf16_conv_length(mapi_nameid_tags[i].Name);
-				break;
-			}
-			mapi_nameid->count++;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_proptag(proptag);
+	if (!entry) return MAPI_E_NOT_FOUND;
 
-	return MAPI_E_NOT_FOUND;
+	return mapi_nameid_entry_add(mapi_nameid, entry);
 }
 
 
@@ -430,15 +470,7 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_canonical_add(struct mapi_nameid *mapi_name
  */
 _PUBLIC_ enum MAPISTATUS mapi_nameid_property_lookup(uint32_t proptag)
 {
-	uint32_t	i;
-
-	for (i = 0; mapi_nameid_tags[i].proptag; i++) {
-		if (mapi_nameid_tags[i].proptag == proptag) {
-			return MAPI_E_SUCCESS;
-		}
-	}
-
-	return MAPI_E_NOT_FOUND;
+	return mapi_nameid_tags_find_proptag(proptag) ? MAPI_E_SUCCESS : MAPI_E_NOT_FOUND;
 }
 
 
@@ -460,22 +492,18 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_property_lookup(uint32_t proptag)
 _PUBLIC_ enum MAPISTATUS mapi_nameid_OOM_lookup(const char *OOM, const char *OLEGUID,
 						uint16_t *propType)
 {
-	uint32_t	i;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!OOM, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].OOM &&
-		    !strcmp(mapi_nameid_tags[i].OOM, OOM) &&
-		    !strcmp(mapi_nameid_tags[i].OLEGUID, OLEGUID)) {
-			*propType = mapi_nameid_tags[i].propType;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_OOM(OOM, OLEGUID);
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_FOUND, NULL);
+
+	*propType = entry->propType;
 
-	OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_FOUND, NULL);
+	return MAPI_E_SUCCESS;
 }
 
 
@@ -497,21 +525,18 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_OOM_lookup(const char *OOM, const char *OLE
 _PUBLIC_ enum MAPISTATUS mapi_nameid_lid_lookup(uint16_t lid, const char *OLEGUID,
 						uint16_t *propType)
 {
-	uint32_t	i;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!lid, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].lid == lid &&
-		    !strcmp(mapi_nameid_tags[i].OLEGUID, OLEGUID)) {
-			*propType = mapi_nameid_tags[i].propType;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_lid(lid, OLEGUID);
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_FOUND, NULL);
 
-	OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_FOUND, NULL);
+	*propType = entry->propType;
+
+	return MAPI_E_SUCCESS;
 }
 
 
@@ -533,22 +558,19 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_lid_lookup(uint16_t lid, const char *OLEGUI
 _PUBLIC_ enum MAPISTATUS mapi_nameid_lid_lookup_canonical(uint16_t lid, const char *OLEGUID,
 							  uint32_t *propTag)
 {
-	uint32_t	i;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!lid, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!propTag, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].lid == lid &&
-		    !strcmp(mapi_nameid_tags[i].OLEGUID, OLEGUID)) {
-			*propTag = mapi_nameid_tags[i].proptag;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_lid(lid, OLEGUID);
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_FOUND, NULL);
 
-	OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_FOUND, NULL);
+	*propTag = entry->proptag;
+
+	return MAPI_E_SUCCESS;
 }
 
 
@@ -571,22 +593,18 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_string_lookup(const char *Name,
 						   const char *OLEGUID,
 						   uint16_t *propType)
 {
-	uint32_t	i;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!Name, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].Name &&
-		    !strcmp(mapi_nameid_tags[i].Name, Name) &&
-		    !strcmp(mapi_nameid_tags[i].OLEGUID, OLEGUID)) {
-			*propType = mapi_nameid_tags[i].propType;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_Name(Name, OLEGUID);
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_FOUND, NULL);
+
+	*propType = entry->propType;
 
-	OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_FOUND, NULL);
+	return MAPI_E_SUCCESS;
 }
 
 
@@ -609,23 +627,19 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_string_lookup_canonical(const char *Name,
 							     const char *OLEGUID,
 							     uint32_t *propTag)
 {
-	uint32_t	i;
+	const struct mapi_nameid_tags	*entry;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!Name, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!OLEGUID, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!propTag, MAPI_E_INVALID_PARAMETER, NULL);
 
-	for (i = 0; mapi_nameid_tags[i].OLEGUID; i++) {
-		if (mapi_nameid_tags[i].Name &&
-		    !strcmp(mapi_nameid_tags[i].Name, Name) &&
-		    !strcmp(mapi_nameid_tags[i].OLEGUID, OLEGUID)) {
-			*propTag = mapi_nameid_tags[i].proptag;
-			return MAPI_E_SUCCESS;
-		}
-	}
+	entry = mapi_nameid_tags_find_Name(Name, OLEGUID);
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_FOUND, NULL);
+
+	*propTag = entry->proptag;
 
-	OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_FOUND, NULL);
+	return MAPI_E_SUCCESS;
 }
 
 
@@ -966,35 +980,45 @@ _PUBLIC_ enum MAPISTATUS mapi_nameid_GetIDsFromNames(struct mapi_nameid *mapi_na
 	return retval;
 }
 
+static const char *get_canonical_namedid_name(uint32_t proptag)
+{
+	uint32_t	count = MAPI_NAMEID_INDEX_COUNT(mapi_nameid_names_by_proptag);
+	uint32_t	pos;
+
+	pos = mapi_nameid_index_lower_bound(mapi_nameid_names_by_proptag, count,
+					    mapi_nameid_names_proptag_cmp, &proptag);
+	if (pos < count && mapi_nameid_names[mapi_nameid_names_by_proptag[pos]].proptag == proptag) {
+		return mapi_nameid_names[mapi_nameid_names_by_proptag[pos]].propname;
+	}
+
+	return NULL;
+}
+
 _PUBLIC_ const char *get_namedid_name(uint32_t proptag)
 {
-	uint32_t idx;
+	const char	*propname;
 
-	for (idx = 0; mapi_nameid_names[idx].proptag; idx++) {
-		if (mapi_nameid_names[idx].proptag == proptag) {
-			return mapi_nameid_names[idx].propname;
-		}
+	propname = get_canonical_namedid_name(proptag);
+	if (propname) {
+		return propname;
 	}
 	if (((proptag & 0xFFFF) == PT_STRING8) ||
 	    ((proptag & 0xFFFF) == PT_MV_STRING8)) {
 		proptag += 1; /* try as _UNICODE variant */
-	}
-	for (idx = 0; mapi_nameid_names[idx].proptag; idx++) {
-		if (mapi_nameid_names[idx].proptag == proptag) {
-			return mapi_nameid_names[idx].propname;
-		}
+		return get_canonical_namedid_name(proptag);
 	}
 	return NULL;
 }
 
 _PUBLIC_ uint32_t get_namedid_value(const char *propname)
 {
-	uint32_t idx;
+	uint32_t	count = MAPI_NAMEID_INDEX_COUNT(mapi_nameid_names_by_propname);
+	uint32_t	pos;
 
-	for (idx = 0; mapi_nameid_names[idx].proptag; idx++) {
-		if (!strcmp(mapi_nameid_names[idx].propname, propname)) {
-			return mapi_nameid_names[idx].proptag;
-		}
+	pos = mapi_nameid_index_lower_bound(mapi_nameid_names_by_propname, count,
+					    mapi_nameid_names_propname_cmp, propname);
+	if (pos < count && !strcmp(mapi_nameid_names[mapi_nameid_names_by_propname[pos]].propname, propname)) {
+		return mapi_nameid_names[mapi_nameid_names_by_propname[pos]].proptag;
 	}
 
 	return 0;
@@ -1002,18 +1026,183 @@ _PUBLIC_ uint32_t get_namedid_value(const char *propname)
 
 _PUBLIC_ uint16_t get_namedid_type(uint16_t untypedtag)
 {
+	uint32_t	count = MAPI_NAMEID_INDEX_COUNT(mapi_nameid_names_by_proptag);
+	uint32_t	proptag = (uint32_t)untypedtag << 16;
+	uint32_t	found = count;
+	uint32_t	pos;
 	uint32_t	idx;
 	uint16_t	current_type;
 
-	for (idx = 0; mapi_nameid_names[idx].proptag; idx++) {
-		if ((mapi_nameid_names[idx].proptag >> 16) == untypedtag) {
-			current_type = mapi_nameid_names[idx].proptag & 0xFFFF;
-			if (current_type != PT_ERROR && current_type != PT_STRING8) {
-				return current_type;
-			}
+	/* Keep the first match in mapi_nameid_names order */
+	for (pos = mapi_nameid_index_lower_bound(mapi_nameid_names_by_proptag, count,
+						 mapi_nameid_names_proptag_cmp, &proptag);
+	     pos < count; pos++) {
+		idx = mapi_nameid_names_by_proptag[pos];
+		if ((mapi_nameid_names[idx].proptag >> 16) != untypedtag) {
+			break;
+		}
+		current_type = mapi_nameid_names[idx].proptag & 0xFFFF;
+		if (current_type != PT_ERROR && current_type != PT_STRING8 && idx < found) {
+			found = idx;
 		}
 	}
+	if (found < count) {
+		return mapi_nameid_names[found].proptag & 0xFFFF;
+	}
 
 	OC_DEBUG(5, "type for property '%x' could not be deduced", untypedtag);
 	return 0;
 }
+
+
+/**
+   \details Compute the cache bucket of a named property for a given
+   logon
+ */
+static uint32_t mapi_nameid_cache_hash(uint8_t logon_id, const struct MAPINAMEID *nameid)
+{
+	uint32_t	hash = 2166136261U;
+	const char	*name;
+
+	hash = (hash ^ logon_id) * 16777619U;
+	hash = (hash ^ nameid->lpguid.time_low) * 16777619U;
+	hash = (hash ^ nameid->ulKind) * 16777619U;
+	switch (nameid->ulKind) {
+	case MNID_ID:
+		hash = (hash ^ nameid->kind.lid) * 16777619U;
+		break;
+	case MNID_STRING:
+		for (name = nameid->kind.lpwstr.Name; name && *name; name++) {
+			hash = (hash ^ (uint8_t)*name) * 16777619U;
+		}
+		break;
+	}
+
+	return hash % MAPI_NAMEID_CACHE_SIZE;
+}
+
+static bool mapi_nameid_cache_match(const struct mapi_nameid_cache_entry *entry,
+				    uint8_t logon_id, const struct MAPINAMEID *nameid)
+{
+	if (entry->logon_id != logon_id || entry->ulKind != nameid->ulKind) return false;
+	if (!GUID_equal(&entry->lpguid, &nameid->lpguid)) return false;
+
+	switch (nameid->ulKind) {
+	case MNID_ID:
+		return (entry->lid == nameid->kind.lid);
+	case MNID_STRING:
+		return (nameid->kind.lpwstr.Name && !strcmp(entry->Name, nameid->kind.lpwstr.Name));
+	}
+
+	return false;
+}
+
+
+/**
+   \details Search the session named properties cache for the
+   property ID a previous GetIDsFromNames call returned
+
+   \param session pointer to the MAPI session
+   \param logon_id the logon the named property belongs to
+   \param nameid the named property to search
+   \param propID pointer on the returned property ID
+
+   \return true if the named property is cached, otherwise false
+ */
+bool mapi_nameid_cache_lookup(struct mapi_session *session, uint8_t logon_id,
+			      const struct MAPINAMEID *nameid, uint16_t *propID)
+{
+	struct mapi_nameid_cache_entry	*entry;
+
+	if (!session || !session->nameid_cache || !nameid || !propID) return false;
+
+	for (entry = session->nameid_cache->buckets[mapi_nameid_cache_hash(logon_id, nameid)];
+	     entry; entry = entry->next) {
+		if (mapi_nameid_cache_match(entry, logon_id, nameid)) {
+			*propID = entry->propID;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+   \details Record the property ID the server mapped a named property
+   to for a given logon
+
+   Named property mappings never change for the lifetime of a
+   mailbox, so entries are kept until the logon is released.
+
+   \param session pointer to the MAPI session
+   \param logon_id the logon the named property belongs to
+   \param nameid the named property
+   \param propID the property ID returned by the server
+ */
+void mapi_nameid_cache_add(struct mapi_session *session, uint8_t logon_id,
+			   const struct MAPINAMEID *nameid, uint16_t propID)
+{
+	struct mapi_nameid_cache_entry	*entry;
+	uint16_t			cached;
+	uint32_t			bucket;
+
+	if (!session || !nameid || !propID) return;
+	if (nameid->ulKind != MNID_ID && nameid->ulKind != MNID_STRING) return;
+	if (nameid->ulKind == MNID_STRING && !nameid->kind.lpwstr.Name) return;
+	if (mapi_nameid_cache_lookup(session, logon_id, nameid, &cached)) return;
+
+	if (!session->nameid_cache) {
+		session->nameid_cache = talloc_zero(session, struct mapi_nameid_cache);
+		if (!session->nameid_cache) return;
+	}
+
+	entry = talloc_zero(session->nameid_cache, struct mapi_nameid_cache_entry);
+	if (!entry) return;
+	entry->logon_id = logon_id;
+	entry->lpguid = nameid->lpguid;
+	entry->ulKind = nameid->ulKind;
+	entry->propID = propID;
+	if (nameid->ulKind == MNID_ID) {
+		entry->lid = nameid->kind.lid;
+	} else {
+		entry->Name = talloc_strdup(entry, nameid->kind.lpwstr.Name);
+		if (!entry->Name) {
+			talloc_free(entry);
+			return;
+		}
+	}
+
+	bucket = mapi_nameid_cache_hash(logon_id, nameid);
+	entry->next = session->nameid_cache->buckets[bucket];
+	session->nameid_cache->buckets[bucket] = entry;
+}
+
+
+/**
+   \details Drop the cached named property mappings of a logon
+
+   \param session pointer to the MAPI session
+   \param logon_id the logon being released
+ */
+void mapi_nameid_cache_flush(struct mapi_session *session, uint8_t logon_id)
+{
+	struct mapi_nameid_cache_entry	**entryp;
+	struct mapi_nameid_cache_entry	*entry;
+	uint32_t			bucket;
+
+	if (!session || !session->nameid_cache) return;
+
+	for (bucket = 0; bucket < MAPI_NAMEID_CACHE_SIZE; bucket++) {
+		entryp = &session->nameid_cache->buckets[bucket];
+		while (*entryp) {
+			entry = *entryp;
+			if (entry->logon_id == logon_id) {
+				*entryp = entry->next;
+				talloc_free(entry);
+			} else {
+				entryp = &entry->next;
+			}
+		}
+	}
+}
@@ -29,6 +29,15 @@ typedef int (*mapi_notify_callback_t)(uint16_t, void *, void *);
 
 typedef int (*mapi_notify_continue_callback_t)(void *);
 
+/* asynchronous notification callback which takes:
+ * - struct mapi_session * = the session notified
+ * - enum MAPISTATUS = MAPI_E_SUCCESS once the notifications are dispatched,
+ *   otherwise the error which stopped the monitoring
+ * - void * = private data pointer
+ * and returns non-zero to stop monitoring the session
+*/
+typedef int (*mapi_async_notify_callback_t)(struct mapi_session *, enum MAPISTATUS, void *);
+
 struct notifications {
 	uint32_t		ulConnection;		/* connection number */
 	uint32_t		NotificationFlags;	/* events mask associated */
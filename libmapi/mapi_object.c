@@ -105,6 +105,7 @@ _PUBLIC_ void mapi_object_release(mapi_object_t *obj)
 
 	if (obj->store == true && obj->session) {
 		obj->session->logon_ids[obj->logon_id] = 0;
+		mapi_nameid_cache_flush(obj->session, obj->logon_id);
 	}
 
 	mapi_object_reset(obj);
@@ -331,6 +332,9 @@ void mapi_object_table_init(TALLOC_CTX *mem_ctx, mapi_object_t *obj_table)
 /**
    \details Fetch a bookmark within a MAPI object table
 
+   Bookmarks are looked up by position in the slots of the table, so
+   the cost doesn't depend on the number of bookmarks.
+
    \param obj_table pointer on the MAPI object table
    \param bkPosition the bookmark position to find
    \param bin pointer on the Sbinary_short the function fills
@@ -343,24 +347,110 @@ enum MAPISTATUS mapi_object_bookmark_find(mapi_object_t *obj_table, uint32_t bkP
 	mapi_object_table_t	*table;
 	mapi_object_bookmark_t	*bookmark;
 
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!obj_table, MAPI_E_INVALID_PARAMETER, NULL);
 	table = (mapi_object_table_t *)obj_table->private_data;
-	bookmark = table->bookmark;
+	OPENCHANGE_RETVAL_IF(!table, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!table->bookmark, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(bkPosition > table->bk_last, MAPI_E_INVALID_BOOKMARK, NULL);
+	OPENCHANGE_RETVAL_IF(bkPosition >= table->bk_slots_count, MAPI_E_INVALID_BOOKMARK, NULL);
+
+	bookmark = table->bk_slots[bkPosition];
+	OPENCHANGE_RETVAL_IF(!bookmark, MAPI_E_INVALID_BOOKMARK, NULL);
+
+	bin->cb = bookmark->bin.cb;
+	bin->lpb = bookmark->bin.lpb;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Store a bookmark returned by the server in a MAPI object
+   table
+
+   \param obj_table pointer on the MAPI object table
+   \param bin the bookmark returned by the server
+   \param bkPosition pointer on the position of the new bookmark
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+enum MAPISTATUS mapi_object_bookmark_add(mapi_object_t *obj_table, struct SBinary_short *bin,
+					 uint32_t *bkPosition)
+{
+	mapi_object_table_t	*table;
+	mapi_object_bookmark_t	*bookmark;
+	mapi_object_bookmark_t	**slots;
+	uint32_t		index;
+	uint32_t		count;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!obj_table, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!bin || !bkPosition, MAPI_E_INVALID_PARAMETER, NULL);
+	table = (mapi_object_table_t *)obj_table->private_data;
 	OPENCHANGE_RETVAL_IF(!table, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!bookmark, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(bkPosition > table->bk_last, MAPI_E_INVALID_BOOKMARK, NULL);
-	
-	while (bookmark) {
-		if (bookmark->index == bkPosition) {
-			bin->cb = bookmark->bin.cb;
-			bin->lpb = bookmark->bin.lpb;
-			return MAPI_E_SUCCESS;
-		}
-		bookmark = bookmark->next;
+	OPENCHANGE_RETVAL_IF(!table->bookmark, MAPI_E_NOT_INITIALIZED, NULL);
+
+	index = table->bk_last + 1;
+	if (index >= table->bk_slots_count) {
+		count = table->bk_slots_count ? table->bk_slots_count * 2 : 16;
+		while (count <= index) count *= 2;
+		slots = talloc_realloc(table, table->bk_slots, mapi_object_bookmark_t *, count);
+		OPENCHANGE_RETVAL_IF(!slots, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		memset(&slots[table->bk_slots_count], 0, (count - table->bk_slots_count) * sizeof (mapi_object_bookmark_t *));
+		table->bk_slots = slots;
+		table->bk_slots_count = count;
+	}
+
+	/* Not under the list head: bookmarks are freed one by one */
+	bookmark = talloc_zero((TALLOC_CTX *)table, mapi_object_bookmark_t);
+	OPENCHANGE_RETVAL_IF(!bookmark, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	bookmark->index = index;
+	bookmark->bin.cb = bin->cb;
+	bookmark->bin.lpb = talloc_memdup((TALLOC_CTX *)bookmark, bin->lpb, bin->cb);
+	OPENCHANGE_RETVAL_IF(bin->cb && !bookmark->bin.lpb, MAPI_E_NOT_ENOUGH_MEMORY, bookmark);
+
+	/* A freed last bookmark leaves its position to the next one */
+	if (table->bk_slots[index]) {
+		mapi_object_bookmark_del(obj_table, index);
 	}
-	return MAPI_E_INVALID_BOOKMARK;
+
+	DLIST_ADD(table->bookmark, bookmark);
+	table->bk_slots[index] = bookmark;
+	table->bk_last = index;
+	*bkPosition = index;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Remove a bookmark from a MAPI object table
+
+   \param obj_table pointer on the MAPI object table
+   \param bkPosition the position of the bookmark to remove
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+enum MAPISTATUS mapi_object_bookmark_del(mapi_object_t *obj_table, uint32_t bkPosition)
+{
+	mapi_object_table_t	*table;
+	mapi_object_bookmark_t	*bookmark;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!obj_table, MAPI_E_INVALID_PARAMETER, NULL);
+	table = (mapi_object_table_t *)obj_table->private_data;
+	OPENCHANGE_RETVAL_IF(!table, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(bkPosition >= table->bk_slots_count, MAPI_E_INVALID_BOOKMARK, NULL);
+
+	bookmark = table->bk_slots[bkPosition];
+	OPENCHANGE_RETVAL_IF(!bookmark, MAPI_E_INVALID_BOOKMARK, NULL);
+
+	table->bk_slots[bkPosition] = NULL;
+	DLIST_REMOVE(table->bookmark, bookmark);
+	talloc_free(bookmark);
+
+	return MAPI_E_SUCCESS;
 }
 
 
@@ -121,6 +121,8 @@ typedef struct mapi_obj_bookmark {
 typedef struct mapi_obj_table {
 	uint32_t			bk_last;
 	mapi_object_bookmark_t		*bookmark;
+	mapi_object_bookmark_t		**bk_slots;	/* bookmarks indexed by position */
+	uint32_t			bk_slots_count;
 	struct SPropTagArray		proptags;
 } mapi_object_table_t;
 
@@ -23,6 +23,7 @@
 
 
 #include <talloc.h>
+#include <time.h>
 
 
 /* forward decls */
@@ -54,6 +55,8 @@ struct mapi_profile
 	uint32_t		method;
 	uint32_t		exchange_version;
 	const char		*kerberos;
+	const char		*nspi_server;		/* resolved by RfrGetNewDSA */
+	time_t			nspi_server_expiry;
 };
 
 typedef int (*mapi_profile_callback_t)(struct PropertyRowSet_r *, const void *);
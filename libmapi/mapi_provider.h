@@ -26,6 +26,7 @@
 struct mapi_object;
 struct mapi_profile;
 struct mapi_notify_ctx;
+struct mapi_async_notify;
 
 enum PROVIDER_ID {
 	PROVIDER_ID_EMSMDB = 0x1,
@@ -44,14 +45,34 @@ struct mapi_objects {
 	struct mapi_objects	*next;
 };
 
+#define	MAPI_NAMEID_CACHE_SIZE	256
+
+/* GetIDsFromNames result for a given logon */
+struct mapi_nameid_cache_entry {
+	uint8_t				logon_id;
+	struct GUID			lpguid;
+	uint8_t				ulKind;
+	uint32_t			lid;
+	char				*Name;
+	uint16_t			propID;
+	struct mapi_nameid_cache_entry	*next;
+};
+
+struct mapi_nameid_cache {
+	struct mapi_nameid_cache_entry	*buckets[MAPI_NAMEID_CACHE_SIZE];
+};
+
 struct mapi_session {
 	struct mapi_provider		*emsmdb;
 	struct mapi_provider		*nspi;
 	struct mapi_profile		*profile;
 	struct mapi_notify_ctx		*notify_ctx;
+	struct mapi_async_notify	*async_notify;	/* MonitorAsyncNotification */
 	struct mapi_objects		*objects;
 	struct mapi_context		*mapi_ctx;
 	uint8_t				logon_ids[255];
+	struct mapi_nameid_cache	*nameid_cache;
+	int				busy;		/* a request is in flight */
 
 	struct mapi_session		*next;
 	struct mapi_session		*prev;
@@ -20,17 +20,201 @@
 */
 
 #include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
 #include <util/debug.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 
-void oc_log(enum oc_log_level level, const char *fmt_string, ...)
+#define	OC_LOG_MODULE_NAME_MAX	32
+#define	OC_LOG_ASYNC_SIZE	1024	/* KB */
+
+/* Level overrides of modules, set with oc_log_set_module_level() */
+static struct {
+	char	name[OC_LOG_MODULE_NAME_MAX];
+	int	level;
+} oc_log_modules[OC_LOG_MAX_MODULES];
+static int oc_log_modules_count = 0;
+
+/* Bumped whenever modules change so call sites resolve theirs again */
+static int oc_log_generation = 0;
+
+#if defined(HAVE_PTHREADS)
+/* Asynchronous sink: a ring buffer drained to fd by a writer thread.
+   head and tail only grow, head - tail bytes are pending. Threads do
+   not survive fork, the ring is therefore set up again in each process
+   which logs. */
+static struct {
+	int		fd;
+	char		*buf;
+	size_t		size;
+	uint64_t	head;
+	uint64_t	tail;
+	uint64_t	inflight;	/* bytes being written by the thread */
+	uint64_t	dropped;
+	pid_t		pid;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cond;
+} oc_log_ring = { .fd = -1 };
+#endif
+
+static int oc_log_samba_level(enum oc_log_level level)
 {
-	va_list ap;
-	va_start(ap, fmt_string);
-	oc_logv(level, fmt_string, ap);
-	va_end(ap);
+	/* Log OC_LOG_FATAL, OC_LOG_ERROR, OC_LOG_WARNING and OC_LOG_INFO
+	 * all at samba debug level 0 */
+	return (level >= 0) ? level : 0;
 }
 
-void oc_logv(enum oc_log_level level, const char *fmt_string, va_list ap)
+#if defined(HAVE_PTHREADS)
+static void *oc_log_ring_writer(void *arg)
+{
+	char		notice[64];
+	struct iovec	iov[2];
+	uint64_t	dropped;
+	size_t		offset;
+	size_t		len;
+	ssize_t		ret;
+
+	while (true) {
+		pthread_mutex_lock(&oc_log_ring.lock);
+		while (oc_log_ring.head == oc_log_ring.tail) {
+			pthread_cond_wait(&oc_log_ring.cond, &oc_log_ring.lock);
+		}
+		/* Producers never write over pending bytes, the range can
+		   be written out without the lock. It ends on a line
+		   boundary and is written at once so that lines are not
+		   split where the ring wraps. */
+		offset = oc_log_ring.tail % oc_log_ring.size;
+		len = oc_log_ring.head - oc_log_ring.tail;
+		iov[0].iov_base = oc_log_ring.buf + offset;
+		iov[0].iov_len = MIN(len, oc_log_ring.size - offset);
+		iov[1].iov_base = oc_log_ring.buf;
+		iov[1].iov_len = len - iov[0].iov_len;
+		oc_log_ring.inflight = len;
+		dropped = oc_log_ring.dropped;
+		oc_log_ring.dropped = 0;
+		pthread_mutex_unlock(&oc_log_ring.lock);
+
+		ret = writev(oc_log_ring.fd, iov, iov[1].iov_len ? 2 : 1);
+		if (dropped) {
+			snprintf(notice, sizeof(notice), "[%d] %"PRIu64" log messages dropped\n",
+				 (int)getpid(), dropped);
+			ret = write(oc_log_ring.fd, notice, strlen(notice));
+		}
+		(void) ret;
+
+		pthread_mutex_lock(&oc_log_ring.lock);
+		oc_log_ring.tail += len;
+		oc_log_ring.inflight = 0;
+		pthread_mutex_unlock(&oc_log_ring.lock);
+	}
+
+	return NULL;
+}
+
+/* Write what is left in the ring when the process exits */
+static void oc_log_ring_flush(void)
+{
+	uint64_t	pos;
+	size_t		offset;
+	size_t		len;
+	ssize_t		ret;
+
+	if (oc_log_ring.pid != getpid()) return;
+
+	/* Skip what the thread is writing, it accounts for it itself */
+	pthread_mutex_lock(&oc_log_ring.lock);
+	for (pos = oc_log_ring.tail + oc_log_ring.inflight; pos != oc_log_ring.head; pos += ret) {
+		offset = pos % oc_log_ring.size;
+		len = MIN(oc_log_ring.head - pos, oc_log_ring.size - offset);
+		ret = write(oc_log_ring.fd, oc_log_ring.buf + offset, len);
+		if (ret <= 0) break;
+	}
+	oc_log_ring.tail = pos - oc_log_ring.inflight;
+	pthread_mutex_unlock(&oc_log_ring.lock);
+}
+
+static bool oc_log_ring_start(void)
+{
+	static bool	registered = false;
+	pthread_attr_t	attr;
+	pthread_t	thread;
+	int		ret;
+
+	oc_log_ring.head = oc_log_ring.tail = oc_log_ring.inflight = oc_log_ring.dropped = 0;
+	pthread_mutex_init(&oc_log_ring.lock, NULL);
+	pthread_cond_init(&oc_log_ring.cond, NULL);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	ret = pthread_create(&thread, &attr, oc_log_ring_writer, NULL);
+	pthread_attr_destroy(&attr);
+	if (ret != 0) {
+		return false;
+	}
+
+	oc_log_ring.pid = getpid();
+	if (!registered) {
+		atexit(oc_log_ring_flush);
+		registered = true;
+	}
+	return true;
+}
+
+/* Queue a line in the ring buffer, false if the sink is not active */
+static bool oc_log_ring_push(enum oc_log_level level, const char *line)
+{
+	char		header[64];
+	struct timeval	tv;
+	struct tm	tm;
+	size_t		hlen, llen, total, offset, first, i;
+	bool		newline;
+	bool		was_empty;
+	const char	*parts[3];
+	size_t		lens[3];
+
+	if (oc_log_ring.fd == -1) return false;
+	if (oc_log_ring.pid != getpid() && !oc_log_ring_start()) {
+		return false;
+	}
+
+	gettimeofday(&tv, NULL);
+	localtime_r(&tv.tv_sec, &tm);
+	hlen = strftime(header, sizeof(header), "[%Y/%m/%d %H:%M:%S", &tm);
+	hlen += snprintf(header + hlen, sizeof(header) - hlen, ".%06ld, %d, %d] ",
+			 (long)tv.tv_usec, oc_log_samba_level(level), (int)getpid());
+
+	llen = strlen(line);
+	newline = (llen == 0 || line[llen - 1] != '\n');
+	parts[0] = header; lens[0] = hlen;
+	parts[1] = line; lens[1] = llen;
+	parts[2] = "\n"; lens[2] = newline ? 1 : 0;
+	total = hlen + llen + lens[2];
+
+	pthread_mutex_lock(&oc_log_ring.lock);
+	if (oc_log_ring.size - (oc_log_ring.head - oc_log_ring.tail) < total) {
+		oc_log_ring.dropped++;
+		pthread_mutex_unlock(&oc_log_ring.lock);
+		return true;
+	}
+	was_empty = (oc_log_ring.head == oc_log_ring.tail);
+	for (i = 0; i < 3; i++) {
+		offset = oc_log_ring.head % oc_log_ring.size;
+		first = MIN(lens[i], oc_log_ring.size - offset);
+		memcpy(oc_log_ring.buf + offset, parts[i], first);
+		memcpy(oc_log_ring.buf, parts[i] + first, lens[i] - first);
+		oc_log_ring.head += lens[i];
+	}
+	if (was_empty) {
+		pthread_cond_signal(&oc_log_ring.cond);
+	}
+	pthread_mutex_unlock(&oc_log_ring.lock);
+
+	return true;
+}
+#endif
+
+static void oc_log_write(enum oc_log_level level, const char *fmt_string, va_list ap)
 {
 	char line[OC_LOG_MAX_LINE];
 	int samba_level;
@@ -39,22 +223,104 @@ void oc_logv(enum oc_log_level level, const char *fmt_string, va_list ap)
 	nwritten = vsnprintf(line, sizeof(line), fmt_string, ap);
 	if (nwritten < 0) return;
 
-	if (level >= 0) {
-		samba_level = level;
-	} else {
-		/* Log OC_LOG_FATAL, OC_LOG_ERROR, OC_LOG_WARNING and OC_LOG_INFO
-		 * all at samba debug level 0 */
-		samba_level = 0;
-	}
+#if defined(HAVE_PTHREADS)
+	if (oc_log_ring_push(level, line)) return;
+#endif
+
+	/* The level has already been checked, possibly against a module
+	 * level above the samba one: bypass the DEBUG() check */
+	samba_level = oc_log_samba_level(level);
+	if (!dbghdrclass(samba_level, DBGC_ALL, __location__, __FUNCTION__)) return;
 
 	/* Add a trailing newline if one is not already present */
-	if (line[strlen(line)-1] == '\n') {
-		DEBUG(samba_level, ("%s", line));
+	if (line[0] && line[strlen(line)-1] == '\n') {
+		dbgtext("%s", line);
 	} else {
-		DEBUG(samba_level, ("%s\n", line));
+		dbgtext("%s\n", line);
 	}
 }
 
+void oc_log(enum oc_log_level level, const char *fmt_string, ...)
+{
+	va_list ap;
+	va_start(ap, fmt_string);
+	oc_logv(level, fmt_string, ap);
+	va_end(ap);
+}
+
+void oc_logv(enum oc_log_level level, const char *fmt_string, va_list ap)
+{
+	if (oc_log_samba_level(level) > debuglevel_get()) return;
+
+	oc_log_write(level, fmt_string, ap);
+}
+
+void oc_log_debug(enum oc_log_level level, const char *fmt_string, ...)
+{
+	va_list ap;
+	va_start(ap, fmt_string);
+	oc_log_write(level, fmt_string, ap);
+	va_end(ap);
+}
+
+/* Return the module of a source file: the one matching its rightmost
+   path component, or -1 */
+static int oc_log_module_lookup(const char *file)
+{
+	const char	*p;
+	const char	*best_p = NULL;
+	int		best = -1;
+	size_t		len;
+	int		i;
+
+	for (i = 0; i < oc_log_modules_count; i++) {
+		if (oc_log_modules[i].level < 0) continue;
+		len = strlen(oc_log_modules[i].name);
+		for (p = strstr(file, oc_log_modules[i].name); p; p = strstr(p + 1, oc_log_modules[i].name)) {
+			if ((p == file || p[-1] == '/') && (p[len] == '/' || p[len] == '.') &&
+			    (!best_p || p > best_p)) {
+				best_p = p;
+				best = i;
+			}
+		}
+	}
+
+	return best;
+}
+
+bool oc_log_enabled(int level, const char *file, struct oc_log_site *site)
+{
+	if (site->generation != oc_log_generation) {
+		site->module = oc_log_module_lookup(file);
+		site->generation = oc_log_generation;
+	}
+
+	if (site->module >= 0) {
+		return oc_log_samba_level(level) <= oc_log_modules[site->module].level;
+	}
+	return oc_log_samba_level(level) <= debuglevel_get();
+}
+
+bool oc_log_set_module_level(const char *module, int level)
+{
+	int	i;
+
+	if (!module || !*module || strlen(module) >= OC_LOG_MODULE_NAME_MAX) return false;
+
+	for (i = 0; i < oc_log_modules_count; i++) {
+		if (!strcmp(oc_log_modules[i].name, module)) break;
+	}
+	if (i == oc_log_modules_count) {
+		if (oc_log_modules_count == OC_LOG_MAX_MODULES) return false;
+		strncpy(oc_log_modules[i].name, module, OC_LOG_MODULE_NAME_MAX - 1);
+		oc_log_modules_count++;
+	}
+	oc_log_modules[i].level = level;
+	oc_log_generation++;
+
+	return true;
+}
+
 void oc_log_init_stdout()
 {
 	setup_logging("", DEBUG_DEFAULT_STDOUT);
@@ -77,4 +343,60 @@ void oc_log_init_user(const char *progname, struct loadparm_context *lp_ctx)
 void oc_log_init_server(const char *progname, struct loadparm_context *lp_ctx)
 {
 	setup_logging(progname, DEBUG_FILE);
+	oc_log_init_options(lp_ctx);
+}
+
+void oc_log_init_options(struct loadparm_context *lp_ctx)
+{
+	TALLOC_CTX	*mem_ctx;
+	const char	**levels;
+	const char	*file;
+	char		*name;
+	char		*sep;
+	int		i;
+#if defined(HAVE_PTHREADS)
+	int		size;
+#endif
+
+	if (!lp_ctx) return;
+
+	/* mapiproxy:log_levels = emsmdb:3 libmapistore:5 */
+	mem_ctx = talloc_new(NULL);
+	levels = lpcfg_parm_string_list(mem_ctx, lp_ctx, NULL, "mapiproxy", "log_levels", NULL);
+	for (i = 0; levels && levels[i]; i++) {
+		name = talloc_strdup(mem_ctx, levels[i]);
+		sep = name ? strchr(name, ':') : NULL;
+		if (sep) {
+			*sep++ = '\0';
+		}
+		if (!sep || !oc_log_set_module_level(name, atoi(sep))) {
+			oc_log(OC_LOG_WARNING, "Invalid mapiproxy:log_levels entry '%s'", levels[i]);
+		}
+	}
+	talloc_free(mem_ctx);
+
+#if defined(HAVE_PTHREADS)
+	file = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "log_async_file");
+	if (!file || oc_log_ring.fd != -1) return;
+
+	size = lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "log_async_size", OC_LOG_ASYNC_SIZE);
+	oc_log_ring.size = ((size > 0) ? size : OC_LOG_ASYNC_SIZE) * 1024;
+	oc_log_ring.buf = malloc(oc_log_ring.size);
+	if (!oc_log_ring.buf) return;
+
+	oc_log_ring.fd = open(file, O_WRONLY|O_APPEND|O_CREAT, 0640);
+	if (oc_log_ring.fd == -1) {
+		oc_log(OC_LOG_ERROR, "Unable to open log file %s: %s", file, strerror(errno));
+		free(oc_log_ring.buf);
+		oc_log_ring.buf = NULL;
+		return;
+	}
+	/* The writer thread is started by the first message */
+	oc_log_ring.pid = 0;
+#else
+	file = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "log_async_file");
+	if (file) {
+		oc_log(OC_LOG_WARNING, "mapiproxy:log_async_file requires thread support, ignored");
+	}
+#endif
 }
@@ -23,9 +23,11 @@
 #define _OC_LOG_H_
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <param.h>
 
 #define OC_LOG_MAX_LINE 1024
+#define OC_LOG_MAX_MODULES 16
 
 /* There are two ways of logging messages in OpenChange.
  *
@@ -39,6 +41,9 @@
  * explicitly pass a flag to get more debugging information.
  * OC_DEBUG() is a macro and will include file/lineno information. OC_DEBUG()
  * statements might be compiled out on some platforms for performance reasons.
+ * The level is checked before the arguments are evaluated, against the level
+ * of the module the source file belongs to when one is set (see
+ * oc_log_set_module_level()) and against the samba debug level otherwise.
  */
 
 enum oc_log_level {
@@ -52,11 +57,23 @@ enum oc_log_level {
 	*/
 };
 
+/* Module a log call site belongs to, resolved from its source file the
+ * first time the site is reached and again when module levels change. */
+struct oc_log_site {
+	int	generation;
+	int	module;
+};
+
 /* Logs source file and line, at log level -priority and with the specified message.
  * This macro is a simple wrapper around oc_log() that adds the
- * source file name and line number to the message. */
-#define OC_DEBUG(priority, format, ...) \
-	oc_log (OC_LOG_DEBUG+(priority), __location__ "(%s): " format, __PRETTY_FUNCTION__, ## __VA_ARGS__)
+ * source file name and line number to the message. Nothing is evaluated
+ * but the level check when the message is not logged. */
+#define OC_DEBUG(priority, format, ...) do { \
+	static struct oc_log_site _oc_log_site = { -1, -1 }; \
+	if (oc_log_enabled(OC_LOG_DEBUG+(priority), __FILE__, &_oc_log_site)) { \
+		oc_log_debug (OC_LOG_DEBUG+(priority), __location__ "(%s): " format, __PRETTY_FUNCTION__, ## __VA_ARGS__); \
+	} \
+} while (0)
 
 /* Write a log message.
  * Like in syslog, a trailing newline is *not* required. The library will add it
@@ -64,6 +81,18 @@ enum oc_log_level {
 void oc_log(enum oc_log_level level, const char *fmt_string, ...);
 void oc_logv(enum oc_log_level level, const char *fmt_string, va_list ap);
 
+/* Write a message whose level was already checked with oc_log_enabled(). */
+void oc_log_debug(enum oc_log_level level, const char *fmt_string, ...);
+
+/* Return whether a message of the given level from the given source file
+ * would be logged. */
+bool oc_log_enabled(int level, const char *file, struct oc_log_site *site);
+
+/* Set the level of the messages logged by the source files having module
+ * among their path components (e.g. "emsmdb", "libmapistore" or "mysql").
+ * A negative level makes the module follow the samba debug level again. */
+bool oc_log_set_module_level(const char *module, int level);
+
 /* Setup functions:: */
 
 /* Initialize logging subsystem to write to stdout or stderr. */
@@ -77,4 +106,10 @@ void oc_log_init_user(const char *progname, struct loadparm_context *lp_ctx);
    defaulting to /var/log/openchange.log */
 void oc_log_init_server(const char *progname, struct loadparm_context *lp_ctx);
 
+/* Apply the mapiproxy:log_levels and mapiproxy:log_async_file smb.conf
+   options. The latter makes messages go through a memory ring buffer
+   written to the file by a background thread, so logging never waits on
+   disk I/O: messages are dropped, and counted, when the buffer is full. */
+void oc_log_init_options(struct loadparm_context *lp_ctx);
+
 #endif /* _OC_LOG_H_ */
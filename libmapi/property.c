@@ -378,6 +378,150 @@ _PUBLIC_ const void *find_SPropValue_data(struct SRow *aRow, uint32_t mapitag)
 	return NULL;
 }
 
+/* Column index of a row set, see SRowSet_index_init() */
+struct SRowSet_index {
+	struct SRowSet	*RowSet;
+	uint32_t	cColumns;
+	uint32_t	mask;		/* number of slots minus 1 */
+	uint32_t	*prop_ids;	/* property identifier of each slot, 0 if free */
+	uint32_t	*columns;	/* column of each slot */
+};
+
+static inline uint32_t SRowSet_index_slot(uint32_t prop_id, uint32_t mask)
+{
+	return (prop_id * 2654435761U) & mask;
+}
+
+/**
+   \details Index the columns of a row set
+
+   The rows returned by QueryRows all have the columns set by
+   SetColumns, in the same order. The index maps the property
+   identifier of each column to its position once, so the properties of
+   each row are then found without scanning the row. Rows not laid out
+   as the columns are still scanned.
+
+   The index keeps a pointer to RowSet: it can be filled again by the
+   next QueryRows call on the same table and still be used.
+
+   \param mem_ctx pointer to the memory context
+   \param RowSet the row set to index
+   \param columns the columns of the table, NULL to take them from the
+   first row of RowSet
+
+   \return the allocated index, NULL on error
+
+   \sa SRowSet_index_get_SPropValue, SRowSet_index_find_data
+ */
+_PUBLIC_ struct SRowSet_index *SRowSet_index_init(TALLOC_CTX *mem_ctx,
+						  struct SRowSet *RowSet,
+						  struct SPropTagArray *columns)
+{
+	struct SRowSet_index	*index;
+	uint32_t		i, slot, prop_id, size, tag;
+
+	/* Sanity checks */
+	if (!RowSet) return NULL;
+	if (!columns && !RowSet->cRows) return NULL;
+
+	index = talloc_zero(mem_ctx, struct SRowSet_index);
+	if (!index) return NULL;
+
+	index->RowSet = RowSet;
+	index->cColumns = columns ? columns->cValues : RowSet->aRow[0].cValues;
+
+	/* At most half of the slots are used */
+	for (size = 8; size < index->cColumns * 2; size <<= 1);
+	index->mask = size - 1;
+	index->prop_ids = talloc_zero_array(index, uint32_t, size);
+	index->columns = talloc_array(index, uint32_t, size);
+	if (!index->prop_ids || !index->columns) {
+		talloc_free(index);
+		return NULL;
+	}
+
+	for (i = 0; i < index->cColumns; i++) {
+		tag = columns ? columns->aulPropTag[i] : RowSet->aRow[0].lpProps[i].ulPropTag;
+		prop_id = tag >> 16;
+		if (!prop_id) continue;
+
+		for (slot = SRowSet_index_slot(prop_id, index->mask);
+		     index->prop_ids[slot] && index->prop_ids[slot] != prop_id;
+		     slot = (slot + 1) & index->mask);
+		/* the first column with this identifier is kept */
+		if (index->prop_ids[slot]) continue;
+
+		index->prop_ids[slot] = prop_id;
+		index->columns[slot] = i;
+	}
+
+	return index;
+}
+
+/**
+   \details Retrieve a property of a row of an indexed row set
+
+   \param index the index returned by SRowSet_index_init()
+   \param row the position of the row in the row set
+   \param ulPropTag the property tag to retrieve
+
+   \return the property value, NULL if the row doesn't have it or its
+   value is an error
+ */
+_PUBLIC_ struct SPropValue *SRowSet_index_get_SPropValue(struct SRowSet_index *index,
+							 uint32_t row,
+							 uint32_t ulPropTag)
+{
+	struct SRow	*aRow;
+	uint32_t	slot, prop_id;
+
+	/* Sanity checks */
+	if (!index || !index->RowSet || row >= index->RowSet->cRows) return NULL;
+
+	aRow = &index->RowSet->aRow[row];
+	if (aRow->cValues != index->cColumns) {
+		return get_SPropValue_SRow(aRow, ulPropTag);
+	}
+
+	prop_id = ulPropTag >> 16;
+	for (slot = SRowSet_index_slot(prop_id, index->mask);
+	     index->prop_ids[slot] && index->prop_ids[slot] != prop_id;
+	     slot = (slot + 1) & index->mask);
+	if (!index->prop_ids[slot]) return NULL;
+
+	if (aRow->lpProps[index->columns[slot]].ulPropTag == ulPropTag) {
+		return &aRow->lpProps[index->columns[slot]];
+	}
+	/* An error value, or another type of the same property */
+	if ((aRow->lpProps[index->columns[slot]].ulPropTag & 0xFFFF) == PT_ERROR) {
+		return NULL;
+	}
+	return get_SPropValue_SRow(aRow, ulPropTag);
+}
+
+/**
+   \details Retrieve the data of a property of a row of an indexed row
+   set, the indexed counterpart of find_SPropValue_data()
+
+   \param index the index returned by SRowSet_index_init()
+   \param row the position of the row in the row set
+   \param ulPropTag the property tag to retrieve
+
+   \return pointer to the property data, NULL if the row doesn't have
+   it or its value is an error
+ */
+_PUBLIC_ const void *SRowSet_index_find_data(struct SRowSet_index *index,
+					     uint32_t row,
+					     uint32_t ulPropTag)
+{
+	struct SPropValue	*lpProp;
+
+	lpProp = SRowSet_index_get_SPropValue(index, row, ulPropTag);
+	if (!lpProp) return NULL;
+
+	return get_SPropValue_data(lpProp);
+}
+
 _PUBLIC_ const void *find_mapi_SPropValue_data(
 					struct mapi_SPropValue_array *properties, uint32_t mapitag)
 {
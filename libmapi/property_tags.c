@@ -3,6 +3,7 @@
 #include "libmapi/libmapi_private.h"
 #include "gen_ndr/ndr_exchange.h"
 #include "libmapi/property_tags.h"
+#include "libmapi/property_altnames.h"
 
 struct mapi_proptags
 {
@@ -11,6 +12,12 @@ struct mapi_proptags
 	const char	*propname;
 };
 
+struct mapi_propaltnames
+{
+	const char	*propname;
+	uint32_t	proptag;
+};
+
 static struct mapi_proptags canonical_property_tags[] = {
 	{ PidTagAccess,                                                       PT_LONG,      "PidTagAccess"                                                      },
 	{ PidTagAccessControlListData,                                        PT_BINARY,    "PidTagAccessControlListData"                                       },
@@ -1189,52 +1196,1634 @@ static struct mapi_proptags canonical_property_tags[] = {
 	{ 0,                                                                  0,            "NULL"                                                              }
 };
 
-_PUBLIC_ const char *get_proptag_name(uint32_t proptag)
+static const uint16_t canonical_property_tags_by_tag[] = {
+	1068, 1067,  145,  144,  217,  960,  216,  959,  219,  218,  315,  314,
+	 333,  332,  369,  368,  463,  464,  562,  561,  676,  675,  706,  705,
+	 727,  728,  751,  750,  758,  757,  798,  797,  659,  660,  824,  823,
+	 836,  835,  840,  839, 1005, 1006, 1052, 1049,  261,  260,  832,  831,
+	1020, 1019, 1051, 1050,  764,  763,  766,  765, 1014, 1013, 1018, 1017,
+	 776,  775,  778,  777,  830,  829,  747,  746,  586,  585,  672,  671,
+	 646,  645,  632,  631,  634,  633,  674,  673,  816,  815,  818,  817,
+	 768,  767,  780,  779,  753,  752,  834,  833,  636,  635,  588,  587,
+	 560,  559,  576,  575,  656,  655,  654,  653,  658,  657,  668,  667,
+	 666,  665,  670,  669, 1036, 1033,  355,  354,  697,  698,  846,  845,
+	1010, 1009, 1012, 1011,  650,  649,  652,  651,  662,  661,  664,  663,
+	 295,  294,  293,  290,  638,  637,  640,  639,  642,  641,  760,  759,
+	 762,  761,  772,  771,  774,  773, 1084, 1083, 1078, 1077,  828,  825,
+	 827,  826,  126,  127,  131,  130,  605,  606,  603,  604,  678,  677,
+	 803,  804,  820,  819,  994,  993,  998,  997, 1054, 1053, 1000,  999,
+	 990,  989,  992,  991,  607,  608,  812,  811,  327,  326,  339,  338,
+	 341,  340,  347,  346,  566,  565,  569,  570,  579,  581,  582,  580,
+	 702,  701,  848,  847,  578,  577,  558,  557,  583,  584,  422,  421,
+	 610,  609,  870,  869,  198,  199,  188,  189,  724,  723,  600,  599,
+	1079, 1080, 1060, 1059, 1058, 1057,  756,  741,  982,  981, 1085, 1086,
+	 365,  364,  375,  374,  377,  376,  378,  379,    0,    5,  863,  864,
+	 476,  475,    3,    4,  548,  547,  806,  805, 1040, 1039,  611,  612,
+	 357,  356,  233,  226,  838,  837,  868,  867,  232,  454,  231,  453,
+	 230,  229,  228,  227,  597,  598,  484,  483,  486,  485,  468,  467,
+	 526,  525,  528,  527,  530,  529,  648,  647,  461,  462,  521,  522,
+	 524,  523,  384,  385,  383,  382,  395,  396,  224,  225,  460,  459,
+	 456,  455,  251,  250,  458,  457,  213,  212,  215,  214,  865,  866,
+	 345,  342,  143,  142,  353,  352,  265,  264,  336,  337,  299,  298,
+	 516,  515,  980,  979, 1062, 1061,  289,  288,  292,  291,  153,  152,
+	 712,  711,  853,  854, 1035, 1034,  850,  849,  851,  852,  150,  151,
+	 149,  148, 1043, 1044, 1041, 1042,  278,  279,  393,  394,  282,  283,
+	 286,  287,  984,  983, 1048, 1047,  147,  146,  281,  280,  277,  276,
+	 389,  388,  275,  274,  488,  487,  490,  489,  494,  493,  496,  495,
+	 498,  497,  810,  809,  492,  491,   11,    8,   10,    9,  373,  372,
+	 627,  628,  400,  399,  311,  310,  169,  171,  170,  168,  173,  172,
+	 175,  174,  177,  176,  184,  185,  181,  180,  191,  190,  197,  196,
+	 201,  200,  813,  814,  203,  202,  183,  182,  187,  186,  161,  160,
+	 163,  162,  165,  164,  167,  166,  178,  179,  195,  194,  193,  192,
+	1072, 1071,  348,  351, 1070, 1069,  349,  350, 1024, 1023,   19,   18,
+	   7,    6,  247,  246,  416,  415,  418,  417,  420,  419,  243,  242,
+	 452,  451,  472,  471,  512,  511,  514,  513,  540,  539,  572,  571,
+	 630,  629, 1056, 1055,  644,  643,  716,  715,  269,  268, 1076, 1075,
+	 335,  334,  614,  613,  726,  725,  235,  237,  234,  236,  596,  595,
+	 740,  739,  249,  248,  694,  693, 1082, 1081,  700,  699, 1088, 1087,
+	 722,  721,  239,  238,  450,  449,  297,  296,  538,  537, 1038, 1037,
+	1046, 1045,  718,  717,  714,  713, 1066, 1065,  500,  499,  156,  155,
+	 434,  436,  433,  435,  157,  154,  988,  987, 1108, 1107,  223,  222,
+	 432,  431,  592,  591,  344,  343,  732,  731,  808,  807, 1032, 1031,
+	 271,  270,  305,  304, 1064, 1063,  410,  409,  413,  414,  546,  545,
+	 602,  601,  710,  709,  241,  240,  267,  266,  257,  256,  438,  437,
+	 440,  439,  444,  443,  446,  445,  448,  447,  442,  441,  682,  681,
+	 684,  683,  688,  687,  690,  689,  692,  691,  686,  685, 1092, 1091,
+	 985,  986,  469,  470,  479,  480,  220,  221,    2,    1,  325,  324,
+	 843,  844,  424,  423,  316,  317,  320,  321,  366,  367,  370,  371,
+	 319,  318,  273,  272,  573,  574,  303,  302,  301,  300,  520,  519,
+	 518,  517,  563,  564, 1015, 1016,  743,  742,  745,  744,  749,  748,
+	 284,  285,  995,  996,  738,  737,  481,  482,  567,  568, 1002, 1001,
+	1022, 1021,  755,  754,  770,  769,  782,  781,  789,  790,  796,  791,
+	 795,  794,  793,  792,  784,  783,  786,  785,  801,  800,  787,  788,
+	 799,  802,  503,  504,  509,  510,  505,  506,  501,  502,  508,  507,
+	 594,  593,  822,  821, 1028, 1027,  708,  707,  253,  252,  720,  719,
+	 899,  900,  901,  902,  896,  893,  892,  891,  889,  890,  895,  894,
+	 897,  898, 1090, 1089,  542,  541,  544,  543,  696,  695,  958,  957,
+	 390,  855,  856,  428,  427,   33,   32,  429,  430,  259,  258,  309,
+	 308,  307,  306,  879,  880,  873,  874,  426,  425,  871,  872,  882,
+	 881,  733,  734,  466,  465,  549,  550,  735,  736,  552,  551,  554,
+	 553,  555,  556,  884,  883,  886,  885,  909,  910,  911,  912,  913,
+	 914,  878,  877,  876,  875,  908,  905,  904,  903,  887,  888,  907,
+	 906,  331,  330,  535,  536,  262,  263,   85,   84, 1025, 1026,  534,
+	 531,  533,  532,  328,  329,  387,  386, 1008, 1007,  313,  312,  392,
+	 391,  704,  703,  590,  589,  474,  473,  477,  478,   93,   92,  255,
+	 254,  159,  158,  622,  621,  623, 1103,  624, 1104,  616,  916, 1004,
+	 615, 1003,  915,  619,  620, 1106, 1105,  380,  381,  618,  617,  626,
+	1102, 1101,  625,  245,  244,  842,  841,  969,  970,  965,  966,  955,
+	 977,  956,  978,  928,  968, 1126,  927, 1125,  967,  936,  935,  926,
+	 972,  971,  923,  922,  962,  961,  921,  973,  412,  974,  411,  405,
+	 975, 1135,  406,  976, 1136,  403,  963,  404,  964, 1141,  402, 1142,
+	 401, 1119,  925, 1120,  924,  930, 1130,  929, 1129, 1118, 1117, 1134,
+	1133, 1140, 1139,  952, 1122, 1121,  951,  943, 1124, 1123,  942,  954,
+	1128, 1127,  953, 1137,  945, 1138,  944, 1113,  950, 1114,  949,  941,
+	1110, 1109,  940,  948,  947,  939,  938,  408,  407,  397,  398,  918,
+	 917,  323,  322,  946,  937,  920,  919,  934,  933,  932,  931, 1116,
+	1115, 1112, 1111, 1131, 1132, 1094, 1093, 1098, 1097, 1096, 1095, 1099,
+	1100,  857,  858,  860,  859,  862,  861,  680,  679,  730,  729,  361,
+	 360,  210,  211,  363,  362,  359,  358,  206,  207,  209,  208,  205,
+	 204,   65,   64,   88,   89,   86,   87,   79,   78,   83,   82,   91,
+	  90,  107,  104,  125,  124,  121,  120,  137,  136,  123,  122,  106,
+	 105,   47,   34,   49,   48,   51,   50,   53,   52,   55,   54,   57,
+	  56,   59,   58,   61,   60,   63,   62,   36,   35,   99,   98,   16,
+	  17,   27,   26,   97,   96,   38,   37,   40,   39,   42,   41,   44,
+	  43,   46,   45,  141,  140,  101,  100,  117,  116,  119,  118,  113,
+	 112,  111,  110,  115,  114,   20,   21,   77,   76,  129,  128,   69,
+	  68,   75,   74,   73,   72,   67,   66, 1074, 1073,  134,  135,  103,
+	 102,  133,  132,   95,   94, 1030, 1029,   13,   12,  139,  138,   29,
+	  28,   31,   30,   71,   70,   24,   25,   22,   23, 1143, 1144, 1145,
+	1146, 1147, 1148, 1149, 1150, 1151, 1152, 1153, 1154, 1155, 1156, 1157,
+	1158, 1159, 1160, 1161, 1162, 1163, 1164, 1165, 1166, 1167, 1168, 1169,
+	1170, 1171, 1172, 1173,   81,   80,  109,  108,   14,   15,
+};
+
+static const uint16_t canonical_property_tags_by_name[] = {
+	   0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,
+	  12,   13,   14,   15,   16,   17,   18,   19,   20,   21,   22,   23,
+	  24,   25,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,
+	  36,   37,   38,   39,   40,   41,   42,   43,   44,   45,   46,   47,
+	  48,   49,   50,   51,   52,   53,   54,   55,   56,   57,   58,   59,
+	  60,   61,   62,   63,   64,   65,   66,   67,   68,   69,   70,   71,
+	  72,   73,   74,   75,   76,   77,   78,   79,   80,   81,   82,   83,
+	  84,   85,   86,   87,   88,   89,   90,   91,   92,   93,   94,   95,
+	  96,   97,   98,   99,  100,  101,  102,  103,  104,  105,  106,  107,
+	 108,  109,  110,  111,  112,  113,  114,  115,  116,  117,  118,  119,
+	 120,  121,  122,  123,  124,  125,  126,  127,  128,  129,  130,  131,
+	 132,  133,  134,  135,  136,  137,  138,  139,  140,  141,  142,  143,
+	 144,  145,  146,  147,  148,  149,  150,  151,  152,  153,  154,  155,
+	 156,  157,  158,  159,  160,  161,  162,  163,  164,  165,  166,  167,
+	 168,  169,  170,  171,  172,  173,  174,  175,  176,  177,  178,  179,
+	 180,  181,  182,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+	 192,  193,  194,  195,  196,  197,  198,  199,  200,  201,  202,  203,
+	 204,  205,  206,  207,  208,  209,  210,  211,  212,  213,  214,  215,
+	 216,  217,  218,  219,  220,  221,  222,  223,  224,  225,  226,  227,
+	 228,  229,  230,  231,  232,  233,  234,  235,  236,  237,  238,  239,
+	 240,  241,  242,  243,  244,  245,  246,  247,  248,  249,  250,  251,
+	 252,  253,  254,  255,  256,  257,  258,  259,  260,  261,  262,  263,
+	 264,  265,  266,  267,  268,  269,  270,  271,  272,  273,  274,  275,
+	 276,  277,  278,  279,  280,  281,  282,  283,  284,  285,  286,  287,
+	 288,  289,  290,  291,  292,  293,  294,  295,  296,  297,  298,  299,
+	 300,  301,  302,  303,  304,  305,  306,  307,  308,  309,  310,  311,
+	 312,  313,  314,  315,  316,  317,  318,  319,  320,  321,  322,  323,
+	 324,  325,  326,  327,  328,  329,  330,  331,  332,  333,  334,  335,
+	 336,  337,  338,  339,  340,  341,  342,  343,  344,  345,  346,  347,
+	 348,  349,  350,  351,  352,  353,  354,  355,  356,  357,  358,  359,
+	 360,  361,  362,  363,  364,  365,  366,  367,  368,  369,  370,  371,
+	 372,  373,  374,  375,  376,  377,  378,  379,  380,  381,  382,  383,
+	 384,  385,  386,  387,  388,  389,  390,  391,  392,  393,  394,  395,
+	 396,  397,  398,  399,  400,  401,  402,  403,  404,  405,  406,  407,
+	 408,  409,  410,  411,  412,  413,  414,  415,  416,  417,  418,  419,
+	 420,  421,  422,  423,  424,  425,  426,  427,  428,  429,  430,  431,
+	 432,  433,  434,  435,  436,  437,  438,  439,  440,  441,  442,  443,
+	 444,  445,  446,  447,  448,  449,  450,  451,  452,  453,  454,  455,
+	 456,  457,  458,  459,  460,  461,  462,  463,  464,  465,  466,  467,
+	 468,  469,  470,  471,  472,  473,  474,  475,  476,  477,  478,  479,
+	 480,  481,  482,  483,  484,  485,  486,  487,  488,  489,  490,  491,
+	 492,  493,  494,  495,  496,  497,  498,  499,  500,  501,  502,  503,
+	 504,  505,  506,  507,  508,  509,  510,  511,  512,  513,  514,  515,
+	 516,  517,  518,  519,  520,  521,  522,  523,  524,  525,  526,  527,
+	 528,  529,  530,  531,  532,  533,  534,  535,  536,  537,  538,  539,
+	 540,  541,  542,  543,  544,  545,  546,  547,  548,  549,  550,  551,
+	 552,  553,  554,  555,  556,  557,  558,  559,  560,  561,  562,  563,
+	 564,  565,  566,  567,  568,  569,  570,  571,  572,  573,  574,  575,
+	 576,  577,  578,  579,  580,  581,  582,  583,  584,  585,  586,  587,
+	 588,  589,  590,  591,  592,  593,  594,  595,  596,  597,  598,  599,
+	 600,  601,  602,  603,  604,  605,  606,  607,  608,  609,  610,  611,
+	 612,  613,  614,  615,  616,  617,  618,  619,  620,  621,  622,  623,
+	 624,  625,  626,  627,  628,  629,  630,  631,  632,  633,  634,  635,
+	 636,  637,  638,  639,  640,  641,  642,  643,  644,  645,  646,  647,
+	 648,  649,  650,  651,  652,  653,  654,  655,  656,  657,  658,  659,
+	 660,  661,  662,  663,  664,  665,  666,  667,  668,  669,  670,  671,
+	 672,  673,  674,  675,  676,  677,  678,  679,  680,  681,  682,  683,
+	 684,  685,  686,  687,  688,  689,  690,  691,  692,  693,  694,  695,
+	 696,  697,  698,  699,  700,  701,  702,  703,  704,  705,  706,  707,
+	 708,  709,  710,  711,  712,  713,  714,  715,  716,  717,  718,  719,
+	 720,  721,  722,  723,  724,  725,  726,  727,  728,  729,  730,  731,
+	 732,  733,  734,  735,  736,  737,  738,  739,  740,  741,  742,  743,
+	 744,  745,  746,  747,  748,  749,  750,  751,  752,  753,  754,  755,
+	 756,  757,  758,  759,  760,  761,  762,  763,  764,  765,  766,  767,
+	 768,  769,  770,  771,  772,  773,  774,  775,  776,  777,  778,  779,
+	 780,  781,  782,  783,  784,  785,  786,  787,  788,  789,  790,  791,
+	 792,  793,  794,  795,  796,  797,  798,  799,  800,  801,  802,  803,
+	 804,  805,  806,  807,  808,  809,  810,  811,  812,  813,  814,  815,
+	 816,  817,  818,  819,  820,  821,  822,  823,  824,  825,  826,  827,
+	 828,  829,  830,  831,  832,  833,  834,  835,  836,  837,  838,  839,
+	 840,  841,  842,  843,  844,  845,  846,  847,  848,  849,  850,  851,
+	 852,  853,  854,  855,  856,  857,  858,  859,  860,  861,  862,  863,
+	 864,  865,  866,  867,  868,  869,  870,  871,  872,  873,  874,  875,
+	 876,  877,  878,  879,  880,  881,  882,  883,  884,  885,  886,  887,
+	 888,  889,  890,  891,  892,  893,  894,  895,  896,  897,  898,  899,
+	 900,  901,  902,  903,  904,  905,  906,  907,  908,  909,  910,  911,
+	 912,  913,  914,  915,  916,  917,  918,  919,  920,  921,  922,  923,
+	 924,  925,  926,  927,  928,  929,  930,  931,  932,  933,  934,  935,
+	 936,  937,  938,  939,  940,  941,  942,  943,  944,  945,  946,  947,
+	 948,  949,  950,  951,  952,  953,  954,  955,  956,  957,  958,  959,
+	 960,  961,  962,  963,  964,  965,  966,  967,  968,  969,  970,  971,
+	 972,  973,  974,  975,  976,  977,  978,  979,  980,  981,  982,  983,
+	 984,  985,  986,  987,  988,  989,  990,  991,  992,  993,  994,  995,
+	 996,  997,  998,  999, 1000, 1001, 1002, 1003, 1004, 1005, 1006, 1007,
+	1008, 1009, 1010, 1011, 1012, 1013, 1014, 1015, 1016, 1017, 1018, 1019,
+	1020, 1021, 1022, 1023, 1024, 1025, 1026, 1027, 1028, 1029, 1030, 1031,
+	1032, 1033, 1034, 1035, 1036, 1037, 1038, 1039, 1040, 1041, 1042, 1043,
+	1044, 1045, 1046, 1047, 1048, 1049, 1050, 1051, 1052, 1053, 1054, 1055,
+	1056, 1057, 1058, 1059, 1060, 1061, 1062, 1063, 1064, 1065, 1066, 1067,
+	1068, 1069, 1070, 1071, 1072, 1073, 1074, 1075, 1076, 1077, 1078, 1079,
+	1080, 1081, 1082, 1083, 1084, 1085, 1086, 1087, 1088, 1089, 1090, 1091,
+	1092, 1093, 1094, 1095, 1096, 1097, 1098, 1099, 1100, 1101, 1102, 1103,
+	1104, 1105, 1106, 1107, 1108, 1109, 1110, 1111, 1112, 1113, 1114, 1115,
+	1116, 1117, 1118, 1119, 1120, 1121, 1122, 1123, 1124, 1125, 1126, 1127,
+	1128, 1129, 1130, 1131, 1132, 1133, 1134, 1135, 1136, 1137, 1138, 1139,
+	1140, 1141, 1142, 1160, 1151, 1159, 1144, 1150, 1164, 1147, 1146, 1161,
+	1156, 1162, 1148, 1168, 1169, 1166, 1171, 1172, 1173, 1167, 1170, 1165,
+	1143, 1158, 1157, 1152, 1153, 1149, 1155, 1145, 1163, 1154,
+};
+
+static const struct mapi_propaltnames property_altnames_table[] = {
+	{ "PR_7BIT_DISPLAY_NAME",                                               PR_7BIT_DISPLAY_NAME                                                 },
+	{ "PR_7BIT_DISPLAY_NAME_ERROR",                                         PR_7BIT_DISPLAY_NAME_ERROR                                           },
+	{ "PR_7BIT_DISPLAY_NAME_UNICODE",                                       PR_7BIT_DISPLAY_NAME_UNICODE                                         },
+	{ "PR_ACCESS",                                                          PR_ACCESS                                                            },
+	{ "PR_ACCESS_ERROR",                                                    PR_ACCESS_ERROR                                                      },
+	{ "PR_ACCESS_LEVEL",                                                    PR_ACCESS_LEVEL                                                      },
+	{ "PR_ACCESS_LEVEL_ERROR",                                              PR_ACCESS_LEVEL_ERROR                                                },
+	{ "PR_ACCOUNT",                                                         PR_ACCOUNT                                                           },
+	{ "PR_ACCOUNT_ERROR",                                                   PR_ACCOUNT_ERROR                                                     },
+	{ "PR_ACCOUNT_UNICODE",                                                 PR_ACCOUNT_UNICODE                                                   },
+	{ "PR_ACL_DATA",                                                        PR_ACL_DATA                                                          },
+	{ "PR_ACL_DATA_ERROR",                                                  PR_ACL_DATA_ERROR                                                    },
+	{ "PR_ADDITIONAL_REN_ENTRYIDS",                                         PR_ADDITIONAL_REN_ENTRYIDS                                           },
+	{ "PR_ADDITIONAL_REN_ENTRYIDS_ERROR",                                   PR_ADDITIONAL_REN_ENTRYIDS_ERROR                                     },
+	{ "PR_ADDITIONAL_REN_ENTRYIDS_EX",                                      PR_ADDITIONAL_REN_ENTRYIDS_EX                                        },
+	{ "PR_ADDITIONAL_REN_ENTRYIDS_EX_ERROR",                                PR_ADDITIONAL_REN_ENTRYIDS_EX_ERROR                                  },
+	{ "PR_ADDRBOOK_MID",                                                    PR_ADDRBOOK_MID                                                      },
+	{ "PR_ADDRESS_BOOK_ENTRYID",                                            PR_ADDRESS_BOOK_ENTRYID                                              },
+	{ "PR_ADDRESS_BOOK_ENTRYID_ERROR",                                      PR_ADDRESS_BOOK_ENTRYID_ERROR                                        },
+	{ "PR_ADDRTYPE",                                                        PR_ADDRTYPE                                                          },
+	{ "PR_ADDRTYPE_ERROR",                                                  PR_ADDRTYPE_ERROR                                                    },
+	{ "PR_ADDRTYPE_UNICODE",                                                PR_ADDRTYPE_UNICODE                                                  },
+	{ "PR_ALTERNATE_RECIPIENT_ALLOWED",                                     PR_ALTERNATE_RECIPIENT_ALLOWED                                       },
+	{ "PR_ALTERNATE_RECIPIENT_ALLOWED_ERROR",                               PR_ALTERNATE_RECIPIENT_ALLOWED_ERROR                                 },
+	{ "PR_ANR",                                                             PR_ANR                                                               },
+	{ "PR_ANR_ERROR",                                                       PR_ANR_ERROR                                                         },
+	{ "PR_ANR_UNICODE",                                                     PR_ANR_UNICODE                                                       },
+	{ "PR_ARCHIVE_DATE",                                                    PR_ARCHIVE_DATE                                                      },
+	{ "PR_ARCHIVE_DATE_ERROR",                                              PR_ARCHIVE_DATE_ERROR                                                },
+	{ "PR_ARCHIVE_PERIOD",                                                  PR_ARCHIVE_PERIOD                                                    },
+	{ "PR_ARCHIVE_PERIOD_ERROR",                                            PR_ARCHIVE_PERIOD_ERROR                                              },
+	{ "PR_ARCHIVE_TAG",                                                     PR_ARCHIVE_TAG                                                       },
+	{ "PR_ARCHIVE_TAG_ERROR",                                               PR_ARCHIVE_TAG_ERROR                                                 },
+	{ "PR_ASSISTANT",                                                       PR_ASSISTANT                                                         },
+	{ "PR_ASSISTANT_ERROR",                                                 PR_ASSISTANT_ERROR                                                   },
+	{ "PR_ASSISTANT_TELEPHONE_NUMBER",                                      PR_ASSISTANT_TELEPHONE_NUMBER                                        },
+	{ "PR_ASSISTANT_TELEPHONE_NUMBER_ERROR",                                PR_ASSISTANT_TELEPHONE_NUMBER_ERROR                                  },
+	{ "PR_ASSISTANT_TELEPHONE_NUMBER_UNICODE",                              PR_ASSISTANT_TELEPHONE_NUMBER_UNICODE                                },
+	{ "PR_ASSISTANT_UNICODE",                                               PR_ASSISTANT_UNICODE                                                 },
+	{ "PR_ASSOC_CONTENT_COUNT",                                             PR_ASSOC_CONTENT_COUNT                                               },
+	{ "PR_ATTACHMENT_CONTACTPHOTO",                                         PR_ATTACHMENT_CONTACTPHOTO                                           },
+	{ "PR_ATTACHMENT_CONTACTPHOTO_ERROR",                                   PR_ATTACHMENT_CONTACTPHOTO_ERROR                                     },
+	{ "PR_ATTACHMENT_FLAGS",                                                PR_ATTACHMENT_FLAGS                                                  },
+	{ "PR_ATTACHMENT_FLAGS_ERROR",                                          PR_ATTACHMENT_FLAGS_ERROR                                            },
+	{ "PR_ATTACHMENT_HIDDEN",                                               PR_ATTACHMENT_HIDDEN                                                 },
+	{ "PR_ATTACHMENT_HIDDEN_ERROR",                                         PR_ATTACHMENT_HIDDEN_ERROR                                           },
+	{ "PR_ATTACHMENT_LINKID",                                               PR_ATTACHMENT_LINKID                                                 },
+	{ "PR_ATTACHMENT_LINKID_ERROR",                                         PR_ATTACHMENT_LINKID_ERROR                                           },
+	{ "PR_ATTACH_ADDITIONAL_INFO",                                          PR_ATTACH_ADDITIONAL_INFO                                            },
+	{ "PR_ATTACH_ADDITIONAL_INFO_ERROR",                                    PR_ATTACH_ADDITIONAL_INFO_ERROR                                      },
+	{ "PR_ATTACH_CONTENT_ID",                                               PR_ATTACH_CONTENT_ID                                                 },
+	{ "PR_ATTACH_CONTENT_ID_ERROR",                                         PR_ATTACH_CONTENT_ID_ERROR                                           },
+	{ "PR_ATTACH_CONTENT_ID_UNICODE",                                       PR_ATTACH_CONTENT_ID_UNICODE                                         },
+	{ "PR_ATTACH_CONTENT_LOCATION",                                         PR_ATTACH_CONTENT_LOCATION                                           },
+	{ "PR_ATTACH_CONTENT_LOCATION_ERROR",                                   PR_ATTACH_CONTENT_LOCATION_ERROR                                     },
+	{ "PR_ATTACH_CONTENT_LOCATION_UNICODE",                                 PR_ATTACH_CONTENT_LOCATION_UNICODE                                   },
+	{ "PR_ATTACH_DATA_BIN",                                                 PR_ATTACH_DATA_BIN                                                   },
+	{ "PR_ATTACH_DATA_BIN_ERROR",                                           PR_ATTACH_DATA_BIN_ERROR                                             },
+	{ "PR_ATTACH_DATA_OBJ",                                                 PR_ATTACH_DATA_OBJ                                                   },
+	{ "PR_ATTACH_DATA_OBJ_ERROR",                                           PR_ATTACH_DATA_OBJ_ERROR                                             },
+	{ "PR_ATTACH_ENCODING",                                                 PR_ATTACH_ENCODING                                                   },
+	{ "PR_ATTACH_ENCODING_ERROR",                                           PR_ATTACH_ENCODING_ERROR                                             },
+	{ "PR_ATTACH_EXTENSION",                                                PR_ATTACH_EXTENSION                                                  },
+	{ "PR_ATTACH_EXTENSION_ERROR",                                          PR_ATTACH_EXTENSION_ERROR                                            },
+	{ "PR_ATTACH_EXTENSION_UNICODE",                                        PR_ATTACH_EXTENSION_UNICODE                                          },
+	{ "PR_ATTACH_FILENAME",                                                 PR_ATTACH_FILENAME                                                   },
+	{ "PR_ATTACH_FILENAME_ERROR",                                           PR_ATTACH_FILENAME_ERROR                                             },
+	{ "PR_ATTACH_FILENAME_UNICODE",                                         PR_ATTACH_FILENAME_UNICODE                                           },
+	{ "PR_ATTACH_FLAGS",                                                    PR_ATTACH_FLAGS                                                      },
+	{ "PR_ATTACH_FLAGS_ERROR",                                              PR_ATTACH_FLAGS_ERROR                                                },
+	{ "PR_ATTACH_LONG_FILENAME",                                            PR_ATTACH_LONG_FILENAME                                              },
+	{ "PR_ATTACH_LONG_FILENAME_ERROR",                                      PR_ATTACH_LONG_FILENAME_ERROR                                        },
+	{ "PR_ATTACH_LONG_FILENAME_UNICODE",                                    PR_ATTACH_LONG_FILENAME_UNICODE                                      },
+	{ "PR_ATTACH_LONG_PATHNAME",                                            PR_ATTACH_LONG_PATHNAME                                              },
+	{ "PR_ATTACH_LONG_PATHNAME_ERROR",                                      PR_ATTACH_LONG_PATHNAME_ERROR                                        },
+	{ "PR_ATTACH_LONG_PATHNAME_UNICODE",                                    PR_ATTACH_LONG_PATHNAME_UNICODE                                      },
+	{ "PR_ATTACH_METHOD",                                                   PR_ATTACH_METHOD                                                     },
+	{ "PR_ATTACH_METHOD_ERROR",                                             PR_ATTACH_METHOD_ERROR                                               },
+	{ "PR_ATTACH_MIME_TAG",                                                 PR_ATTACH_MIME_TAG                                                   },
+	{ "PR_ATTACH_MIME_TAG_ERROR",                                           PR_ATTACH_MIME_TAG_ERROR                                             },
+	{ "PR_ATTACH_MIME_TAG_UNICODE",                                         PR_ATTACH_MIME_TAG_UNICODE                                           },
+	{ "PR_ATTACH_NUM",                                                      PR_ATTACH_NUM                                                        },
+	{ "PR_ATTACH_NUM_ERROR",                                                PR_ATTACH_NUM_ERROR                                                  },
+	{ "PR_ATTACH_PATHNAME",                                                 PR_ATTACH_PATHNAME                                                   },
+	{ "PR_ATTACH_PATHNAME_ERROR",                                           PR_ATTACH_PATHNAME_ERROR                                             },
+	{ "PR_ATTACH_PATHNAME_UNICODE",                                         PR_ATTACH_PATHNAME_UNICODE                                           },
+	{ "PR_ATTACH_PAYLOAD_CLASS",                                            PR_ATTACH_PAYLOAD_CLASS                                              },
+	{ "PR_ATTACH_PAYLOAD_CLASS_ERROR",                                      PR_ATTACH_PAYLOAD_CLASS_ERROR                                        },
+	{ "PR_ATTACH_PAYLOAD_CLASS_UNICODE",                                    PR_ATTACH_PAYLOAD_CLASS_UNICODE                                      },
+	{ "PR_ATTACH_PAYLOAD_PROV_GUID_STR",                                    PR_ATTACH_PAYLOAD_PROV_GUID_STR                                      },
+	{ "PR_ATTACH_PAYLOAD_PROV_GUID_STR_ERROR",                              PR_ATTACH_PAYLOAD_PROV_GUID_STR_ERROR                                },
+	{ "PR_ATTACH_PAYLOAD_PROV_GUID_STR_UNICODE",                            PR_ATTACH_PAYLOAD_PROV_GUID_STR_UNICODE                              },
+	{ "PR_ATTACH_RENDERING",                                                PR_ATTACH_RENDERING                                                  },
+	{ "PR_ATTACH_RENDERING_ERROR",                                          PR_ATTACH_RENDERING_ERROR                                            },
+	{ "PR_ATTACH_SIZE",                                                     PR_ATTACH_SIZE                                                       },
+	{ "PR_ATTACH_SIZE_ERROR",                                               PR_ATTACH_SIZE_ERROR                                                 },
+	{ "PR_ATTACH_TAG",                                                      PR_ATTACH_TAG                                                        },
+	{ "PR_ATTACH_TAG_ERROR",                                                PR_ATTACH_TAG_ERROR                                                  },
+	{ "PR_ATTACH_TRANSPORT_NAME",                                           PR_ATTACH_TRANSPORT_NAME                                             },
+	{ "PR_ATTACH_TRANSPORT_NAME_ERROR",                                     PR_ATTACH_TRANSPORT_NAME_ERROR                                       },
+	{ "PR_ATTACH_TRANSPORT_NAME_UNICODE",                                   PR_ATTACH_TRANSPORT_NAME_UNICODE                                     },
+	{ "PR_ATTR_HIDDEN",                                                     PR_ATTR_HIDDEN                                                       },
+	{ "PR_ATTR_HIDDEN_ERROR",                                               PR_ATTR_HIDDEN_ERROR                                                 },
+	{ "PR_ATTR_READONLY",                                                   PR_ATTR_READONLY                                                     },
+	{ "PR_ATTR_READONLY_ERROR",                                             PR_ATTR_READONLY_ERROR                                               },
+	{ "PR_AUTO_FORWARDED",                                                  PR_AUTO_FORWARDED                                                    },
+	{ "PR_AUTO_FORWARDED_ERROR",                                            PR_AUTO_FORWARDED_ERROR                                              },
+	{ "PR_AUTO_FORWARD_COMMENT",                                            PR_AUTO_FORWARD_COMMENT                                              },
+	{ "PR_AUTO_FORWARD_COMMENT_ERROR",                                      PR_AUTO_FORWARD_COMMENT_ERROR                                        },
+	{ "PR_AUTO_FORWARD_COMMENT_UNICODE",                                    PR_AUTO_FORWARD_COMMENT_UNICODE                                      },
+	{ "PR_AUTO_RESPONSE_SUPPRESS",                                          PR_AUTO_RESPONSE_SUPPRESS                                            },
+	{ "PR_AUTO_RESPONSE_SUPPRESS_ERROR",                                    PR_AUTO_RESPONSE_SUPPRESS_ERROR                                      },
+	{ "PR_BIRTHDAY",                                                        PR_BIRTHDAY                                                          },
+	{ "PR_BIRTHDAY_ERROR",                                                  PR_BIRTHDAY_ERROR                                                    },
+	{ "PR_BLOCK_STATUS",                                                    PR_BLOCK_STATUS                                                      },
+	{ "PR_BLOCK_STATUS_ERROR",                                              PR_BLOCK_STATUS_ERROR                                                },
+	{ "PR_BODY",                                                            PR_BODY                                                              },
+	{ "PR_BODY_CONTENT_ID",                                                 PR_BODY_CONTENT_ID                                                   },
+	{ "PR_BODY_CONTENT_ID_ERROR",                                           PR_BODY_CONTENT_ID_ERROR                                             },
+	{ "PR_BODY_CONTENT_ID_UNICODE",                                         PR_BODY_CONTENT_ID_UNICODE                                           },
+	{ "PR_BODY_CONTENT_LOCATION",                                           PR_BODY_CONTENT_LOCATION                                             },
+	{ "PR_BODY_CONTENT_LOCATION_ERROR",                                     PR_BODY_CONTENT_LOCATION_ERROR                                       },
+	{ "PR_BODY_CONTENT_LOCATION_UNICODE",                                   PR_BODY_CONTENT_LOCATION_UNICODE                                     },
+	{ "PR_BODY_ERROR",                                                      PR_BODY_ERROR                                                        },
+	{ "PR_BODY_HTML",                                                       PR_BODY_HTML                                                         },
+	{ "PR_BODY_HTML_ERROR",                                                 PR_BODY_HTML_ERROR                                                   },
+	{ "PR_BODY_HTML_UNICODE",                                               PR_BODY_HTML_UNICODE                                                 },
+	{ "PR_BODY_UNICODE",                                                    PR_BODY_UNICODE                                                      },
+	{ "PR_BUSINESS2_TELEPHONE_NUMBER_A_MV",                                 PR_BUSINESS2_TELEPHONE_NUMBER_A_MV                                   },
+	{ "PR_BUSINESS2_TELEPHONE_NUMBER_A_MV_ERROR",                           PR_BUSINESS2_TELEPHONE_NUMBER_A_MV_ERROR                             },
+	{ "PR_BUSINESS2_TELEPHONE_NUMBER_A_MV_UNICODE",                         PR_BUSINESS2_TELEPHONE_NUMBER_A_MV_UNICODE                           },
+	{ "PR_BUSINESS_ADDRESS_COUNTRY",                                        PR_BUSINESS_ADDRESS_COUNTRY                                          },
+	{ "PR_BUSINESS_ADDRESS_COUNTRY_ERROR",                                  PR_BUSINESS_ADDRESS_COUNTRY_ERROR                                    },
+	{ "PR_BUSINESS_ADDRESS_COUNTRY_UNICODE",                                PR_BUSINESS_ADDRESS_COUNTRY_UNICODE                                  },
+	{ "PR_BUSINESS_ADDRESS_LOCALITY",                                       PR_BUSINESS_ADDRESS_LOCALITY                                         },
+	{ "PR_BUSINESS_ADDRESS_LOCALITY_ERROR",                                 PR_BUSINESS_ADDRESS_LOCALITY_ERROR                                   },
+	{ "PR_BUSINESS_ADDRESS_LOCALITY_UNICODE",                               PR_BUSINESS_ADDRESS_LOCALITY_UNICODE                                 },
+	{ "PR_BUSINESS_ADDRESS_POSTAL_CODE",                                    PR_BUSINESS_ADDRESS_POSTAL_CODE                                      },
+	{ "PR_BUSINESS_ADDRESS_POSTAL_CODE_ERROR",                              PR_BUSINESS_ADDRESS_POSTAL_CODE_ERROR                                },
+	{ "PR_BUSINESS_ADDRESS_POSTAL_CODE_UNICODE",                            PR_BUSINESS_ADDRESS_POSTAL_CODE_UNICODE                              },
+	{ "PR_BUSINESS_ADDRESS_POST_OFFICE_BOX",                                PR_BUSINESS_ADDRESS_POST_OFFICE_BOX                                  },
+	{ "PR_BUSINESS_ADDRESS_POST_OFFICE_BOX_ERROR",                          PR_BUSINESS_ADDRESS_POST_OFFICE_BOX_ERROR                            },
+	{ "PR_BUSINESS_ADDRESS_POST_OFFICE_BOX_UNICODE",                        PR_BUSINESS_ADDRESS_POST_OFFICE_BOX_UNICODE                          },
+	{ "PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE",                              PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE                                },
+	{ "PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE_ERROR",                        PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE_ERROR                          },
+	{ "PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE_UNICODE",                      PR_BUSINESS_ADDRESS_STATE_OR_PROVINCE_UNICODE                        },
+	{ "PR_BUSINESS_ADDRESS_STREET",                                         PR_BUSINESS_ADDRESS_STREET                                           },
+	{ "PR_BUSINESS_ADDRESS_STREET_ERROR",                                   PR_BUSINESS_ADDRESS_STREET_ERROR                                     },
+	{ "PR_BUSINESS_ADDRESS_STREET_UNICODE",                                 PR_BUSINESS_ADDRESS_STREET_UNICODE                                   },
+	{ "PR_BUSINESS_FAX_NUMBER",                                             PR_BUSINESS_FAX_NUMBER                                               },
+	{ "PR_BUSINESS_FAX_NUMBER_ERROR",                                       PR_BUSINESS_FAX_NUMBER_ERROR                                         },
+	{ "PR_BUSINESS_FAX_NUMBER_UNICODE",                                     PR_BUSINESS_FAX_NUMBER_UNICODE                                       },
+	{ "PR_BUSINESS_HOME_PAGE",                                              PR_BUSINESS_HOME_PAGE                                                },
+	{ "PR_BUSINESS_HOME_PAGE_ERROR",                                        PR_BUSINESS_HOME_PAGE_ERROR                                          },
+	{ "PR_BUSINESS_HOME_PAGE_UNICODE",                                      PR_BUSINESS_HOME_PAGE_UNICODE                                        },
+	{ "PR_BUSINESS_TELEPHONE_NUMBER",                                       PR_BUSINESS_TELEPHONE_NUMBER                                         },
+	{ "PR_BUSINESS_TELEPHONE_NUMBER_ERROR",                                 PR_BUSINESS_TELEPHONE_NUMBER_ERROR                                   },
+	{ "PR_BUSINESS_TELEPHONE_NUMBER_UNICODE",                               PR_BUSINESS_TELEPHONE_NUMBER_UNICODE                                 },
+	{ "PR_CALLBACK_TELEPHONE_NUMBER",                                       PR_CALLBACK_TELEPHONE_NUMBER                                         },
+	{ "PR_CALLBACK_TELEPHONE_NUMBER_ERROR",                                 PR_CALLBACK_TELEPHONE_NUMBER_ERROR                                   },
+	{ "PR_CALLBACK_TELEPHONE_NUMBER_UNICODE",                               PR_CALLBACK_TELEPHONE_NUMBER_UNICODE                                 },
+	{ "PR_CAR_TELEPHONE_NUMBER",                                            PR_CAR_TELEPHONE_NUMBER                                              },
+	{ "PR_CAR_TELEPHONE_NUMBER_ERROR",                                      PR_CAR_TELEPHONE_NUMBER_ERROR                                        },
+	{ "PR_CAR_TELEPHONE_NUMBER_UNICODE",                                    PR_CAR_TELEPHONE_NUMBER_UNICODE                                      },
+	{ "PR_CDO_RECURRENCEID",                                                PR_CDO_RECURRENCEID                                                  },
+	{ "PR_CDO_RECURRENCEID_ERROR",                                          PR_CDO_RECURRENCEID_ERROR                                            },
+	{ "PR_CHANGE_KEY",                                                      PR_CHANGE_KEY                                                        },
+	{ "PR_CHANGE_KEY_ERROR",                                                PR_CHANGE_KEY_ERROR                                                  },
+	{ "PR_CHILDRENS_NAMES",                                                 PR_CHILDRENS_NAMES                                                   },
+	{ "PR_CHILDRENS_NAMES_ERROR",                                           PR_CHILDRENS_NAMES_ERROR                                             },
+	{ "PR_CHILDRENS_NAMES_UNICODE",                                         PR_CHILDRENS_NAMES_UNICODE                                           },
+	{ "PR_CLIENT_ACTIONS",                                                  PR_CLIENT_ACTIONS                                                    },
+	{ "PR_CLIENT_ACTIONS_ERROR",                                            PR_CLIENT_ACTIONS_ERROR                                              },
+	{ "PR_CLIENT_SUBMIT_TIME",                                              PR_CLIENT_SUBMIT_TIME                                                },
+	{ "PR_CLIENT_SUBMIT_TIME_ERROR",                                        PR_CLIENT_SUBMIT_TIME_ERROR                                          },
+	{ "PR_CODE_PAGE_ID",                                                    PR_CODE_PAGE_ID                                                      },
+	{ "PR_CODE_PAGE_ID_ERROR",                                              PR_CODE_PAGE_ID_ERROR                                                },
+	{ "PR_COMMENT",                                                         PR_COMMENT                                                           },
+	{ "PR_COMMENT_ERROR",                                                   PR_COMMENT_ERROR                                                     },
+	{ "PR_COMMENT_UNICODE",                                                 PR_COMMENT_UNICODE                                                   },
+	{ "PR_COMPANY_MAIN_PHONE_NUMBER",                                       PR_COMPANY_MAIN_PHONE_NUMBER                                         },
+	{ "PR_COMPANY_MAIN_PHONE_NUMBER_ERROR",                                 PR_COMPANY_MAIN_PHONE_NUMBER_ERROR                                   },
+	{ "PR_COMPANY_MAIN_PHONE_NUMBER_UNICODE",                               PR_COMPANY_MAIN_PHONE_NUMBER_UNICODE                                 },
+	{ "PR_COMPANY_NAME",                                                    PR_COMPANY_NAME                                                      },
+	{ "PR_COMPANY_NAME_ERROR",                                              PR_COMPANY_NAME_ERROR                                                },
+	{ "PR_COMPANY_NAME_UNICODE",                                            PR_COMPANY_NAME_UNICODE                                              },
+	{ "PR_COMPUTER_NETWORK_NAME",                                           PR_COMPUTER_NETWORK_NAME                                             },
+	{ "PR_COMPUTER_NETWORK_NAME_ERROR",                                     PR_COMPUTER_NETWORK_NAME_ERROR                                       },
+	{ "PR_COMPUTER_NETWORK_NAME_UNICODE",                                   PR_COMPUTER_NETWORK_NAME_UNICODE                                     },
+	{ "PR_CONFLICT_ENTRYID",                                                PR_CONFLICT_ENTRYID                                                  },
+	{ "PR_CONFLICT_ENTRYID_ERROR",                                          PR_CONFLICT_ENTRYID_ERROR                                            },
+	{ "PR_CONTAINER_CLASS",                                                 PR_CONTAINER_CLASS                                                   },
+	{ "PR_CONTAINER_CLASS_ERROR",                                           PR_CONTAINER_CLASS_ERROR                                             },
+	{ "PR_CONTAINER_CLASS_UNICODE",                                         PR_CONTAINER_CLASS_UNICODE                                           },
+	{ "PR_CONTAINER_CONTENTS",                                              PR_CONTAINER_CONTENTS                                                },
+	{ "PR_CONTAINER_CONTENTS_ERROR",                                        PR_CONTAINER_CONTENTS_ERROR                                          },
+	{ "PR_CONTAINER_FLAGS",                                                 PR_CONTAINER_FLAGS                                                   },
+	{ "PR_CONTAINER_FLAGS_ERROR",                                           PR_CONTAINER_FLAGS_ERROR                                             },
+	{ "PR_CONTAINER_HIERARCHY",                                             PR_CONTAINER_HIERARCHY                                               },
+	{ "PR_CONTAINER_HIERARCHY_ERROR",                                       PR_CONTAINER_HIERARCHY_ERROR                                         },
+	{ "PR_CONTENT_COUNT",                                                   PR_CONTENT_COUNT                                                     },
+	{ "PR_CONTENT_COUNT_ERROR",                                             PR_CONTENT_COUNT_ERROR                                               },
+	{ "PR_CONTENT_FILTER_SCL",                                              PR_CONTENT_FILTER_SCL                                                },
+	{ "PR_CONTENT_FILTER_SCL_ERROR",                                        PR_CONTENT_FILTER_SCL_ERROR                                          },
+	{ "PR_CONTENT_UNREAD",                                                  PR_CONTENT_UNREAD                                                    },
+	{ "PR_CONTENT_UNREAD_ERROR",                                            PR_CONTENT_UNREAD_ERROR                                              },
+	{ "PR_CONVERSATION_ID",                                                 PR_CONVERSATION_ID                                                   },
+	{ "PR_CONVERSATION_ID_ERROR",                                           PR_CONVERSATION_ID_ERROR                                             },
+	{ "PR_CONVERSATION_INDEX",                                              PR_CONVERSATION_INDEX                                                },
+	{ "PR_CONVERSATION_INDEX_ERROR",                                        PR_CONVERSATION_INDEX_ERROR                                          },
+	{ "PR_CONVERSATION_INDEX_TRACKING",                                     PR_CONVERSATION_INDEX_TRACKING                                       },
+	{ "PR_CONVERSATION_INDEX_TRACKING_ERROR",                               PR_CONVERSATION_INDEX_TRACKING_ERROR                                 },
+	{ "PR_CONVERSATION_KEY",                                                PR_CONVERSATION_KEY                                                  },
+	{ "PR_CONVERSATION_TOPIC",                                              PR_CONVERSATION_TOPIC                                                },
+	{ "PR_CONVERSATION_TOPIC_ERROR",                                        PR_CONVERSATION_TOPIC_ERROR                                          },
+	{ "PR_CONVERSATION_TOPIC_UNICODE",                                      PR_CONVERSATION_TOPIC_UNICODE                                        },
+	{ "PR_COUNTRY",                                                         PR_COUNTRY                                                           },
+	{ "PR_COUNTRY_ERROR",                                                   PR_COUNTRY_ERROR                                                     },
+	{ "PR_COUNTRY_UNICODE",                                                 PR_COUNTRY_UNICODE                                                   },
+	{ "PR_CREATION_TIME",                                                   PR_CREATION_TIME                                                     },
+	{ "PR_CREATION_TIME_ERROR",                                             PR_CREATION_TIME_ERROR                                               },
+	{ "PR_CREATOR_ENTRYID",                                                 PR_CREATOR_ENTRYID                                                   },
+	{ "PR_CREATOR_ENTRYID_ERROR",                                           PR_CREATOR_ENTRYID_ERROR                                             },
+	{ "PR_CREATOR_NAME",                                                    PR_CREATOR_NAME                                                      },
+	{ "PR_CREATOR_NAME_ERROR",                                              PR_CREATOR_NAME_ERROR                                                },
+	{ "PR_CREATOR_NAME_UNICODE",                                            PR_CREATOR_NAME_UNICODE                                              },
+	{ "PR_CREATOR_SID",                                                     PR_CREATOR_SID                                                       },
+	{ "PR_CUSTOMER_ID",                                                     PR_CUSTOMER_ID                                                       },
+	{ "PR_CUSTOMER_ID_ERROR",                                               PR_CUSTOMER_ID_ERROR                                                 },
+	{ "PR_CUSTOMER_ID_UNICODE",                                             PR_CUSTOMER_ID_UNICODE                                               },
+	{ "PR_DAM_BACK_PATCHED",                                                PR_DAM_BACK_PATCHED                                                  },
+	{ "PR_DAM_BACK_PATCHED_ERROR",                                          PR_DAM_BACK_PATCHED_ERROR                                            },
+	{ "PR_DAM_ORIGINAL_ENTRYID",                                            PR_DAM_ORIGINAL_ENTRYID                                              },
+	{ "PR_DAM_ORIGINAL_ENTRYID_ERROR",                                      PR_DAM_ORIGINAL_ENTRYID_ERROR                                        },
+	{ "PR_DAM_ORIG_MSG_SVREID",                                             PR_DAM_ORIG_MSG_SVREID                                               },
+	{ "PR_DAM_ORIG_MSG_SVREID_ERROR",                                       PR_DAM_ORIG_MSG_SVREID_ERROR                                         },
+	{ "PR_DEFAULT_PROFILE",                                                 PR_DEFAULT_PROFILE                                                   },
+	{ "PR_DEFERRED_DELIVERY_TIME",                                          PR_DEFERRED_DELIVERY_TIME                                            },
+	{ "PR_DEFERRED_DELIVERY_TIME_ERROR",                                    PR_DEFERRED_DELIVERY_TIME_ERROR                                      },
+	{ "PR_DEFERRED_SEND_NUMBER",                                            PR_DEFERRED_SEND_NUMBER                                              },
+	{ "PR_DEFERRED_SEND_NUMBER_ERROR",                                      PR_DEFERRED_SEND_NUMBER_ERROR                                        },
+	{ "PR_DEFERRED_SEND_TIME",                                              PR_DEFERRED_SEND_TIME                                                },
+	{ "PR_DEFERRED_SEND_TIME_ERROR",                                        PR_DEFERRED_SEND_TIME_ERROR                                          },
+	{ "PR_DEFERRED_SEND_UNITS",                                             PR_DEFERRED_SEND_UNITS                                               },
+	{ "PR_DEFERRED_SEND_UNITS_ERROR",                                       PR_DEFERRED_SEND_UNITS_ERROR                                         },
+	{ "PR_DEF_POST_MSGCLASS",                                               PR_DEF_POST_MSGCLASS                                                 },
+	{ "PR_DEF_POST_MSGCLASS_ERROR",                                         PR_DEF_POST_MSGCLASS_ERROR                                           },
+	{ "PR_DEF_POST_MSGCLASS_UNICODE",                                       PR_DEF_POST_MSGCLASS_UNICODE                                         },
+	{ "PR_DELEGATED_BY_RULE",                                               PR_DELEGATED_BY_RULE                                                 },
+	{ "PR_DELEGATED_BY_RULE_ERROR",                                         PR_DELEGATED_BY_RULE_ERROR                                           },
+	{ "PR_DELEGATE_FLAGS",                                                  PR_DELEGATE_FLAGS                                                    },
+	{ "PR_DELEGATE_FLAGS_ERROR",                                            PR_DELEGATE_FLAGS_ERROR                                              },
+	{ "PR_DELETED_COUNT_TOTAL",                                             PR_DELETED_COUNT_TOTAL                                               },
+	{ "PR_DELETED_COUNT_TOTAL_ERROR",                                       PR_DELETED_COUNT_TOTAL_ERROR                                         },
+	{ "PR_DELETED_MSG_COUNT",                                               PR_DELETED_MSG_COUNT                                                 },
+	{ "PR_DELETED_ON",                                                      PR_DELETED_ON                                                        },
+	{ "PR_DELETED_ON_ERROR",                                                PR_DELETED_ON_ERROR                                                  },
+	{ "PR_DELETE_AFTER_SUBMIT",                                             PR_DELETE_AFTER_SUBMIT                                               },
+	{ "PR_DELETE_AFTER_SUBMIT_ERROR",                                       PR_DELETE_AFTER_SUBMIT_ERROR                                         },
+	{ "PR_DELIVER_TIME",                                                    PR_DELIVER_TIME                                                      },
+	{ "PR_DELIVER_TIME_ERROR",                                              PR_DELIVER_TIME_ERROR                                                },
+	{ "PR_DEPARTMENT_NAME",                                                 PR_DEPARTMENT_NAME                                                   },
+	{ "PR_DEPARTMENT_NAME_ERROR",                                           PR_DEPARTMENT_NAME_ERROR                                             },
+	{ "PR_DEPARTMENT_NAME_UNICODE",                                         PR_DEPARTMENT_NAME_UNICODE                                           },
+	{ "PR_DEPTH",                                                           PR_DEPTH                                                             },
+	{ "PR_DEPTH_ERROR",                                                     PR_DEPTH_ERROR                                                       },
+	{ "PR_DISPLAY_BCC",                                                     PR_DISPLAY_BCC                                                       },
+	{ "PR_DISPLAY_BCC_ERROR",                                               PR_DISPLAY_BCC_ERROR                                                 },
+	{ "PR_DISPLAY_BCC_UNICODE",                                             PR_DISPLAY_BCC_UNICODE                                               },
+	{ "PR_DISPLAY_CC",                                                      PR_DISPLAY_CC                                                        },
+	{ "PR_DISPLAY_CC_ERROR",                                                PR_DISPLAY_CC_ERROR                                                  },
+	{ "PR_DISPLAY_CC_UNICODE",                                              PR_DISPLAY_CC_UNICODE                                                },
+	{ "PR_DISPLAY_NAME",                                                    PR_DISPLAY_NAME                                                      },
+	{ "PR_DISPLAY_NAME_ERROR",                                              PR_DISPLAY_NAME_ERROR                                                },
+	{ "PR_DISPLAY_NAME_PREFIX",                                             PR_DISPLAY_NAME_PREFIX                                               },
+	{ "PR_DISPLAY_NAME_PREFIX_ERROR",                                       PR_DISPLAY_NAME_PREFIX_ERROR                                         },
+	{ "PR_DISPLAY_NAME_PREFIX_UNICODE",                                     PR_DISPLAY_NAME_PREFIX_UNICODE                                       },
+	{ "PR_DISPLAY_NAME_UNICODE",                                            PR_DISPLAY_NAME_UNICODE                                              },
+	{ "PR_DISPLAY_TO",                                                      PR_DISPLAY_TO                                                        },
+	{ "PR_DISPLAY_TO_ERROR",                                                PR_DISPLAY_TO_ERROR                                                  },
+	{ "PR_DISPLAY_TO_UNICODE",                                              PR_DISPLAY_TO_UNICODE                                                },
+	{ "PR_DISPLAY_TYPE",                                                    PR_DISPLAY_TYPE                                                      },
+	{ "PR_DISPLAY_TYPE_ERROR",                                              PR_DISPLAY_TYPE_ERROR                                                },
+	{ "PR_DISPLAY_TYPE_EX",                                                 PR_DISPLAY_TYPE_EX                                                   },
+	{ "PR_DISPLAY_TYPE_EX_ERROR",                                           PR_DISPLAY_TYPE_EX_ERROR                                             },
+	{ "PR_DSN_REMOTE_MTA",                                                  PR_DSN_REMOTE_MTA                                                    },
+	{ "PR_DSN_REMOTE_MTA_ERROR",                                            PR_DSN_REMOTE_MTA_ERROR                                              },
+	{ "PR_DSN_REMOTE_MTA_UNICODE",                                          PR_DSN_REMOTE_MTA_UNICODE                                            },
+	{ "PR_EMAIL_ADDRESS",                                                   PR_EMAIL_ADDRESS                                                     },
+	{ "PR_EMAIL_ADDRESS_ERROR",                                             PR_EMAIL_ADDRESS_ERROR                                               },
+	{ "PR_EMAIL_ADDRESS_UNICODE",                                           PR_EMAIL_ADDRESS_UNICODE                                             },
+	{ "PR_EMS_AB_ASSOC_NT_ACCOUNT",                                         PR_EMS_AB_ASSOC_NT_ACCOUNT                                           },
+	{ "PR_EMS_AB_AUTH_ORIG",                                                PR_EMS_AB_AUTH_ORIG                                                  },
+	{ "PR_EMS_AB_AUTH_ORIG_ERROR",                                          PR_EMS_AB_AUTH_ORIG_ERROR                                            },
+	{ "PR_EMS_AB_CONTAINERID",                                              PR_EMS_AB_CONTAINERID                                                },
+	{ "PR_EMS_AB_CONTAINERID_ERROR",                                        PR_EMS_AB_CONTAINERID_ERROR                                          },
+	{ "PR_EMS_AB_DELIV_CONT_LENGTH",                                        PR_EMS_AB_DELIV_CONT_LENGTH                                          },
+	{ "PR_EMS_AB_DELIV_CONT_LENGTH_ERROR",                                  PR_EMS_AB_DELIV_CONT_LENGTH_ERROR                                    },
+	{ "PR_EMS_AB_DISPLAY_NAME_PRINTABLE",                                   PR_EMS_AB_DISPLAY_NAME_PRINTABLE                                     },
+	{ "PR_EMS_AB_DISPLAY_NAME_PRINTABLE_ERROR",                             PR_EMS_AB_DISPLAY_NAME_PRINTABLE_ERROR                               },
+	{ "PR_EMS_AB_DISPLAY_NAME_PRINTABLE_UNICODE",                           PR_EMS_AB_DISPLAY_NAME_PRINTABLE_UNICODE                             },
+	{ "PR_EMS_AB_DISPLAY_TYPE_EX",                                          PR_EMS_AB_DISPLAY_TYPE_EX                                            },
+	{ "PR_EMS_AB_DISPLAY_TYPE_EX_ERROR",                                    PR_EMS_AB_DISPLAY_TYPE_EX_ERROR                                      },
+	{ "PR_EMS_AB_DL_EXTERNAL_MEMBER_COUNT",                                 PR_EMS_AB_DL_EXTERNAL_MEMBER_COUNT                                   },
+	{ "PR_EMS_AB_DL_EXTERNAL_MEMBER_COUNT_ERROR",                           PR_EMS_AB_DL_EXTERNAL_MEMBER_COUNT_ERROR                             },
+	{ "PR_EMS_AB_DL_TOTAL_MEMBER_COUNT",                                    PR_EMS_AB_DL_TOTAL_MEMBER_COUNT                                      },
+	{ "PR_EMS_AB_DL_TOTAL_MEMBER_COUNT_ERROR",                              PR_EMS_AB_DL_TOTAL_MEMBER_COUNT_ERROR                                },
+	{ "PR_EMS_AB_ENABLE_MODERATION",                                        PR_EMS_AB_ENABLE_MODERATION                                          },
+	{ "PR_EMS_AB_ENABLE_MODERATION_ERROR",                                  PR_EMS_AB_ENABLE_MODERATION_ERROR                                    },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_1",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_1                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_10",                                   PR_EMS_AB_EXTENSION_ATTRIBUTE_10                                     },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_10_ERROR",                             PR_EMS_AB_EXTENSION_ATTRIBUTE_10_ERROR                               },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_10_UNICODE",                           PR_EMS_AB_EXTENSION_ATTRIBUTE_10_UNICODE                             },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_11",                                   PR_EMS_AB_EXTENSION_ATTRIBUTE_11                                     },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_11_ERROR",                             PR_EMS_AB_EXTENSION_ATTRIBUTE_11_ERROR                               },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_11_UNICODE",                           PR_EMS_AB_EXTENSION_ATTRIBUTE_11_UNICODE                             },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_12",                                   PR_EMS_AB_EXTENSION_ATTRIBUTE_12                                     },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_12_ERROR",                             PR_EMS_AB_EXTENSION_ATTRIBUTE_12_ERROR                               },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_12_UNICODE",                           PR_EMS_AB_EXTENSION_ATTRIBUTE_12_UNICODE                             },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_13",                                   PR_EMS_AB_EXTENSION_ATTRIBUTE_13                                     },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_13_ERROR",                             PR_EMS_AB_EXTENSION_ATTRIBUTE_13_ERROR                               },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_13_UNICODE",                           PR_EMS_AB_EXTENSION_ATTRIBUTE_13_UNICODE                             },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_14",                                   PR_EMS_AB_EXTENSION_ATTRIBUTE_14                                     },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_14_ERROR",                             PR_EMS_AB_EXTENSION_ATTRIBUTE_14_ERROR                               },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_14_UNICODE",                           PR_EMS_AB_EXTENSION_ATTRIBUTE_14_UNICODE                             },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_15",                                   PR_EMS_AB_EXTENSION_ATTRIBUTE_15                                     },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_15_ERROR",                             PR_EMS_AB_EXTENSION_ATTRIBUTE_15_ERROR                               },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_15_UNICODE",                           PR_EMS_AB_EXTENSION_ATTRIBUTE_15_UNICODE                             },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_1_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_1_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_1_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_1_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_2",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_2                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_2_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_2_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_2_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_2_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_3",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_3                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_3_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_3_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_3_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_3_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_4",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_4                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_4_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_4_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_4_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_4_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_5",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_5                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_5_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_5_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_5_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_5_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_6",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_6                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_6_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_6_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_6_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_6_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_7",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_7                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_7_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_7_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_7_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_7_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_8",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_8                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_8_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_8_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_8_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_8_UNICODE                              },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_9",                                    PR_EMS_AB_EXTENSION_ATTRIBUTE_9                                      },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_9_ERROR",                              PR_EMS_AB_EXTENSION_ATTRIBUTE_9_ERROR                                },
+	{ "PR_EMS_AB_EXTENSION_ATTRIBUTE_9_UNICODE",                            PR_EMS_AB_EXTENSION_ATTRIBUTE_9_UNICODE                              },
+	{ "PR_EMS_AB_FOLDER_PATHNAME",                                          PR_EMS_AB_FOLDER_PATHNAME                                            },
+	{ "PR_EMS_AB_FOLDER_PATHNAME_ERROR",                                    PR_EMS_AB_FOLDER_PATHNAME_ERROR                                      },
+	{ "PR_EMS_AB_FOLDER_PATHNAME_UNICODE",                                  PR_EMS_AB_FOLDER_PATHNAME_UNICODE                                    },
+	{ "PR_EMS_AB_HAB_CHILD_DEPARTMENTS",                                    PR_EMS_AB_HAB_CHILD_DEPARTMENTS                                      },
+	{ "PR_EMS_AB_HAB_CHILD_DEPARTMENTS_ERROR",                              PR_EMS_AB_HAB_CHILD_DEPARTMENTS_ERROR                                },
+	{ "PR_EMS_AB_HAB_DEPARTMENT_MEMBERS",                                   PR_EMS_AB_HAB_DEPARTMENT_MEMBERS                                     },
+	{ "PR_EMS_AB_HAB_DEPARTMENT_MEMBERS_ERROR",                             PR_EMS_AB_HAB_DEPARTMENT_MEMBERS_ERROR                               },
+	{ "PR_EMS_AB_HAB_IS_HIERARCHICAL_GROUP",                                PR_EMS_AB_HAB_IS_HIERARCHICAL_GROUP                                  },
+	{ "PR_EMS_AB_HAB_IS_HIERARCHICAL_GROUP_ERROR",                          PR_EMS_AB_HAB_IS_HIERARCHICAL_GROUP_ERROR                            },
+	{ "PR_EMS_AB_HAB_PARENT_DEPARTMENT",                                    PR_EMS_AB_HAB_PARENT_DEPARTMENT                                      },
+	{ "PR_EMS_AB_HAB_PARENT_DEPARTMENT_ERROR",                              PR_EMS_AB_HAB_PARENT_DEPARTMENT_ERROR                                },
+	{ "PR_EMS_AB_HAB_ROOT_DEPARTMENT",                                      PR_EMS_AB_HAB_ROOT_DEPARTMENT                                        },
+	{ "PR_EMS_AB_HAB_ROOT_DEPARTMENT_ERROR",                                PR_EMS_AB_HAB_ROOT_DEPARTMENT_ERROR                                  },
+	{ "PR_EMS_AB_HAB_SHOW_IN_DEPARTMENTS",                                  PR_EMS_AB_HAB_SHOW_IN_DEPARTMENTS                                    },
+	{ "PR_EMS_AB_HAB_SHOW_IN_DEPARTMENTS_ERROR",                            PR_EMS_AB_HAB_SHOW_IN_DEPARTMENTS_ERROR                              },
+	{ "PR_EMS_AB_HOME_MDB",                                                 PR_EMS_AB_HOME_MDB                                                   },
+	{ "PR_EMS_AB_HOME_MDB_ERROR",                                           PR_EMS_AB_HOME_MDB_ERROR                                             },
+	{ "PR_EMS_AB_HOME_MTA",                                                 PR_EMS_AB_HOME_MTA                                                   },
+	{ "PR_EMS_AB_IS_MASTER",                                                PR_EMS_AB_IS_MASTER                                                  },
+	{ "PR_EMS_AB_IS_MASTER_ERROR",                                          PR_EMS_AB_IS_MASTER_ERROR                                            },
+	{ "PR_EMS_AB_IS_MEMBER_OF_DL",                                          PR_EMS_AB_IS_MEMBER_OF_DL                                            },
+	{ "PR_EMS_AB_IS_MEMBER_OF_DL_ERROR",                                    PR_EMS_AB_IS_MEMBER_OF_DL_ERROR                                      },
+	{ "PR_EMS_AB_IS_ORGANIZATIONAL",                                        PR_EMS_AB_IS_ORGANIZATIONAL                                          },
+	{ "PR_EMS_AB_IS_ORGANIZATIONAL_ERROR",                                  PR_EMS_AB_IS_ORGANIZATIONAL_ERROR                                    },
+	{ "PR_EMS_AB_MANAGER",                                                  PR_EMS_AB_MANAGER                                                    },
+	{ "PR_EMS_AB_MANAGER_ERROR",                                            PR_EMS_AB_MANAGER_ERROR                                              },
+	{ "PR_EMS_AB_MANAGER_T",                                                PR_EMS_AB_MANAGER_T                                                  },
+	{ "PR_EMS_AB_MANAGER_T_ERROR",                                          PR_EMS_AB_MANAGER_T_ERROR                                            },
+	{ "PR_EMS_AB_MANAGER_T_UNICODE",                                        PR_EMS_AB_MANAGER_T_UNICODE                                          },
+	{ "PR_EMS_AB_MANAGE_DL",                                                PR_EMS_AB_MANAGE_DL                                                  },
+	{ "PR_EMS_AB_MANAGE_DL_ERROR",                                          PR_EMS_AB_MANAGE_DL_ERROR                                            },
+	{ "PR_EMS_AB_MEMBER",                                                   PR_EMS_AB_MEMBER                                                     },
+	{ "PR_EMS_AB_MEMBER_ERROR",                                             PR_EMS_AB_MEMBER_ERROR                                               },
+	{ "PR_EMS_AB_NETWORK_ADDRESS",                                          PR_EMS_AB_NETWORK_ADDRESS                                            },
+	{ "PR_EMS_AB_NETWORK_ADDRESS_ERROR",                                    PR_EMS_AB_NETWORK_ADDRESS_ERROR                                      },
+	{ "PR_EMS_AB_NETWORK_ADDRESS_UNICODE",                                  PR_EMS_AB_NETWORK_ADDRESS_UNICODE                                    },
+	{ "PR_EMS_AB_OBJECT_GUID",                                              PR_EMS_AB_OBJECT_GUID                                                },
+	{ "PR_EMS_AB_OBJECT_GUID_ERROR",                                        PR_EMS_AB_OBJECT_GUID_ERROR                                          },
+	{ "PR_EMS_AB_OBJ_DIST_NAME",                                            PR_EMS_AB_OBJ_DIST_NAME                                              },
+	{ "PR_EMS_AB_OBJ_DIST_NAME_ERROR",                                      PR_EMS_AB_OBJ_DIST_NAME_ERROR                                        },
+	{ "PR_EMS_AB_OBJ_DIST_NAME_UNICODE",                                    PR_EMS_AB_OBJ_DIST_NAME_UNICODE                                      },
+	{ "PR_EMS_AB_ORG_UNIT_ROOT_DN",                                         PR_EMS_AB_ORG_UNIT_ROOT_DN                                           },
+	{ "PR_EMS_AB_ORG_UNIT_ROOT_DN_ERROR",                                   PR_EMS_AB_ORG_UNIT_ROOT_DN_ERROR                                     },
+	{ "PR_EMS_AB_ORG_UNIT_ROOT_DN_UNICODE",                                 PR_EMS_AB_ORG_UNIT_ROOT_DN_UNICODE                                   },
+	{ "PR_EMS_AB_OWNER_BL_O",                                               PR_EMS_AB_OWNER_BL_O                                                 },
+	{ "PR_EMS_AB_OWNER_BL_O_ERROR",                                         PR_EMS_AB_OWNER_BL_O_ERROR                                           },
+	{ "PR_EMS_AB_OWNER_O",                                                  PR_EMS_AB_OWNER_O                                                    },
+	{ "PR_EMS_AB_OWNER_O_ERROR",                                            PR_EMS_AB_OWNER_O_ERROR                                              },
+	{ "PR_EMS_AB_PARENT_ENTRYID",                                           PR_EMS_AB_PARENT_ENTRYID                                             },
+	{ "PR_EMS_AB_PARENT_ENTRYID_ERROR",                                     PR_EMS_AB_PARENT_ENTRYID_ERROR                                       },
+	{ "PR_EMS_AB_PHONETIC_COMPANY_NAME",                                    PR_EMS_AB_PHONETIC_COMPANY_NAME                                      },
+	{ "PR_EMS_AB_PHONETIC_COMPANY_NAME_ERROR",                              PR_EMS_AB_PHONETIC_COMPANY_NAME_ERROR                                },
+	{ "PR_EMS_AB_PHONETIC_COMPANY_NAME_UNICODE",                            PR_EMS_AB_PHONETIC_COMPANY_NAME_UNICODE                              },
+	{ "PR_EMS_AB_PHONETIC_DEPARTMENT_NAME",                                 PR_EMS_AB_PHONETIC_DEPARTMENT_NAME                                   },
+	{ "PR_EMS_AB_PHONETIC_DEPARTMENT_NAME_ERROR",                           PR_EMS_AB_PHONETIC_DEPARTMENT_NAME_ERROR                             },
+	{ "PR_EMS_AB_PHONETIC_DEPARTMENT_NAME_UNICODE",                         PR_EMS_AB_PHONETIC_DEPARTMENT_NAME_UNICODE                           },
+	{ "PR_EMS_AB_PHONETIC_DISPLAY_NAME",                                    PR_EMS_AB_PHONETIC_DISPLAY_NAME                                      },
+	{ "PR_EMS_AB_PHONETIC_DISPLAY_NAME_ERROR",                              PR_EMS_AB_PHONETIC_DISPLAY_NAME_ERROR                                },
+	{ "PR_EMS_AB_PHONETIC_DISPLAY_NAME_UNICODE",                            PR_EMS_AB_PHONETIC_DISPLAY_NAME_UNICODE                              },
+	{ "PR_EMS_AB_PHONETIC_GIVEN_NAME",                                      PR_EMS_AB_PHONETIC_GIVEN_NAME                                        },
+	{ "PR_EMS_AB_PHONETIC_GIVEN_NAME_ERROR",                                PR_EMS_AB_PHONETIC_GIVEN_NAME_ERROR                                  },
+	{ "PR_EMS_AB_PHONETIC_GIVEN_NAME_UNICODE",                              PR_EMS_AB_PHONETIC_GIVEN_NAME_UNICODE                                },
+	{ "PR_EMS_AB_PHONETIC_SURNAME",                                         PR_EMS_AB_PHONETIC_SURNAME                                           },
+	{ "PR_EMS_AB_PHONETIC_SURNAME_ERROR",                                   PR_EMS_AB_PHONETIC_SURNAME_ERROR                                     },
+	{ "PR_EMS_AB_PHONETIC_SURNAME_UNICODE",                                 PR_EMS_AB_PHONETIC_SURNAME_UNICODE                                   },
+	{ "PR_EMS_AB_PROXY_ADDRESSES",                                          PR_EMS_AB_PROXY_ADDRESSES                                            },
+	{ "PR_EMS_AB_PROXY_ADDRESSES_ERROR",                                    PR_EMS_AB_PROXY_ADDRESSES_ERROR                                      },
+	{ "PR_EMS_AB_PROXY_ADDRESSES_UNICODE",                                  PR_EMS_AB_PROXY_ADDRESSES_UNICODE                                    },
+	{ "PR_EMS_AB_PUBLIC_DELEGATES",                                         PR_EMS_AB_PUBLIC_DELEGATES                                           },
+	{ "PR_EMS_AB_PUBLIC_DELEGATES_ERROR",                                   PR_EMS_AB_PUBLIC_DELEGATES_ERROR                                     },
+	{ "PR_EMS_AB_REPORTS",                                                  PR_EMS_AB_REPORTS                                                    },
+	{ "PR_EMS_AB_REPORTS_ERROR",                                            PR_EMS_AB_REPORTS_ERROR                                              },
+	{ "PR_EMS_AB_ROOM_CAPACITY",                                            PR_EMS_AB_ROOM_CAPACITY                                              },
+	{ "PR_EMS_AB_ROOM_CAPACITY_ERROR",                                      PR_EMS_AB_ROOM_CAPACITY_ERROR                                        },
+	{ "PR_EMS_AB_ROOM_CONTAINERS",                                          PR_EMS_AB_ROOM_CONTAINERS                                            },
+	{ "PR_EMS_AB_ROOM_CONTAINERS_ERROR",                                    PR_EMS_AB_ROOM_CONTAINERS_ERROR                                      },
+	{ "PR_EMS_AB_ROOM_CONTAINERS_UNICODE",                                  PR_EMS_AB_ROOM_CONTAINERS_UNICODE                                    },
+	{ "PR_EMS_AB_ROOM_DESCRIPTION",                                         PR_EMS_AB_ROOM_DESCRIPTION                                           },
+	{ "PR_EMS_AB_ROOM_DESCRIPTION_ERROR",                                   PR_EMS_AB_ROOM_DESCRIPTION_ERROR                                     },
+	{ "PR_EMS_AB_ROOM_DESCRIPTION_UNICODE",                                 PR_EMS_AB_ROOM_DESCRIPTION_UNICODE                                   },
+	{ "PR_EMS_AB_TARGET_ADDRESS",                                           PR_EMS_AB_TARGET_ADDRESS                                             },
+	{ "PR_EMS_AB_TARGET_ADDRESS_ERROR",                                     PR_EMS_AB_TARGET_ADDRESS_ERROR                                       },
+	{ "PR_EMS_AB_TARGET_ADDRESS_UNICODE",                                   PR_EMS_AB_TARGET_ADDRESS_UNICODE                                     },
+	{ "PR_EMS_AB_THUMBNAIL_PHOTO",                                          PR_EMS_AB_THUMBNAIL_PHOTO                                            },
+	{ "PR_EMS_AB_THUMBNAIL_PHOTO_ERROR",                                    PR_EMS_AB_THUMBNAIL_PHOTO_ERROR                                      },
+	{ "PR_EMS_AB_UM_SPOKEN_NAME",                                           PR_EMS_AB_UM_SPOKEN_NAME                                             },
+	{ "PR_EMS_AB_UM_SPOKEN_NAME_ERROR",                                     PR_EMS_AB_UM_SPOKEN_NAME_ERROR                                       },
+	{ "PR_EMS_AB_UNAUTH_ORIG",                                              PR_EMS_AB_UNAUTH_ORIG                                                },
+	{ "PR_EMS_AB_UNAUTH_ORIG_ERROR",                                        PR_EMS_AB_UNAUTH_ORIG_ERROR                                          },
+	{ "PR_EMS_AB_X509_CERT",                                                PR_EMS_AB_X509_CERT                                                  },
+	{ "PR_EMS_AB_X509_CERT_ERROR",                                          PR_EMS_AB_X509_CERT_ERROR                                            },
+	{ "PR_EMS_SCRIPT_BLOB",                                                 PR_EMS_SCRIPT_BLOB                                                   },
+	{ "PR_EMS_SCRIPT_BLOB_ERROR",                                           PR_EMS_SCRIPT_BLOB_ERROR                                             },
+	{ "PR_EMS_TEMPLATE_BLOB",                                               PR_EMS_TEMPLATE_BLOB                                                 },
+	{ "PR_EMS_TEMPLATE_BLOB_ERROR",                                         PR_EMS_TEMPLATE_BLOB_ERROR                                           },
+	{ "PR_END_DATE",                                                        PR_END_DATE                                                          },
+	{ "PR_END_DATE_ERROR",                                                  PR_END_DATE_ERROR                                                    },
+	{ "PR_ENTRYID",                                                         PR_ENTRYID                                                           },
+	{ "PR_ENTRYID_ERROR",                                                   PR_ENTRYID_ERROR                                                     },
+	{ "PR_EXCEPTION_ENDTIME",                                               PR_EXCEPTION_ENDTIME                                                 },
+	{ "PR_EXCEPTION_ENDTIME_ERROR",                                         PR_EXCEPTION_ENDTIME_ERROR                                           },
+	{ "PR_EXCEPTION_REPLACETIME",                                           PR_EXCEPTION_REPLACETIME                                             },
+	{ "PR_EXCEPTION_REPLACETIME_ERROR",                                     PR_EXCEPTION_REPLACETIME_ERROR                                       },
+	{ "PR_EXCEPTION_STARTTIME",                                             PR_EXCEPTION_STARTTIME                                               },
+	{ "PR_EXCEPTION_STARTTIME_ERROR",                                       PR_EXCEPTION_STARTTIME_ERROR                                         },
+	{ "PR_EXPIRY_NUMBER",                                                   PR_EXPIRY_NUMBER                                                     },
+	{ "PR_EXPIRY_NUMBER_ERROR",                                             PR_EXPIRY_NUMBER_ERROR                                               },
+	{ "PR_EXPIRY_TIME",                                                     PR_EXPIRY_TIME                                                       },
+	{ "PR_EXPIRY_TIME_ERROR",                                               PR_EXPIRY_TIME_ERROR                                                 },
+	{ "PR_EXPIRY_UNITS",                                                    PR_EXPIRY_UNITS                                                      },
+	{ "PR_EXPIRY_UNITS_ERROR",                                              PR_EXPIRY_UNITS_ERROR                                                },
+	{ "PR_EXTENDED_ACL_DATA",                                               PR_EXTENDED_ACL_DATA                                                 },
+	{ "PR_EXTENDED_FOLDER_FLAGS",                                           PR_EXTENDED_FOLDER_FLAGS                                             },
+	{ "PR_EXTENDED_FOLDER_FLAGS_ERROR",                                     PR_EXTENDED_FOLDER_FLAGS_ERROR                                       },
+	{ "PR_EXTENDED_RULE_MSG_ACTIONS",                                       PR_EXTENDED_RULE_MSG_ACTIONS                                         },
+	{ "PR_EXTENDED_RULE_MSG_ACTIONS_ERROR",                                 PR_EXTENDED_RULE_MSG_ACTIONS_ERROR                                   },
+	{ "PR_EXTENDED_RULE_MSG_CONDITION",                                     PR_EXTENDED_RULE_MSG_CONDITION                                       },
+	{ "PR_EXTENDED_RULE_MSG_CONDITION_ERROR",                               PR_EXTENDED_RULE_MSG_CONDITION_ERROR                                 },
+	{ "PR_EXTENDED_RULE_SIZE_LIMIT",                                        PR_EXTENDED_RULE_SIZE_LIMIT                                          },
+	{ "PR_EXTENDED_RULE_SIZE_LIMIT_ERROR",                                  PR_EXTENDED_RULE_SIZE_LIMIT_ERROR                                    },
+	{ "PR_FID",                                                             PR_FID                                                               },
+	{ "PR_FLAG_COMPLETE_TIME",                                              PR_FLAG_COMPLETE_TIME                                                },
+	{ "PR_FLAG_COMPLETE_TIME_ERROR",                                        PR_FLAG_COMPLETE_TIME_ERROR                                          },
+	{ "PR_FLAG_STATUS",                                                     PR_FLAG_STATUS                                                       },
+	{ "PR_FLAG_STATUS_ERROR",                                               PR_FLAG_STATUS_ERROR                                                 },
+	{ "PR_FLAT_URL_NAME",                                                   PR_FLAT_URL_NAME                                                     },
+	{ "PR_FLAT_URL_NAME_ERROR",                                             PR_FLAT_URL_NAME_ERROR                                               },
+	{ "PR_FLAT_URL_NAME_UNICODE",                                           PR_FLAT_URL_NAME_UNICODE                                             },
+	{ "PR_FOLDER_ASSOCIATED_CONTENTS",                                      PR_FOLDER_ASSOCIATED_CONTENTS                                        },
+	{ "PR_FOLDER_ASSOCIATED_CONTENTS_ERROR",                                PR_FOLDER_ASSOCIATED_CONTENTS_ERROR                                  },
+	{ "PR_FOLDER_CHILD_COUNT",                                              PR_FOLDER_CHILD_COUNT                                                },
+	{ "PR_FOLDER_TYPE",                                                     PR_FOLDER_TYPE                                                       },
+	{ "PR_FOLDER_TYPE_ERROR",                                               PR_FOLDER_TYPE_ERROR                                                 },
+	{ "PR_FOLDER_VIEWLIST",                                                 PR_FOLDER_VIEWLIST                                                   },
+	{ "PR_FOLDER_XVIEWINFO_E",                                              PR_FOLDER_XVIEWINFO_E                                                },
+	{ "PR_FOLLOWUP_ICON",                                                   PR_FOLLOWUP_ICON                                                     },
+	{ "PR_FOLLOWUP_ICON_ERROR",                                             PR_FOLLOWUP_ICON_ERROR                                               },
+	{ "PR_FREEBUSY_ALL_EVENTS",                                             PR_FREEBUSY_ALL_EVENTS                                               },
+	{ "PR_FREEBUSY_ALL_MONTHS",                                             PR_FREEBUSY_ALL_MONTHS                                               },
+	{ "PR_FREEBUSY_BUSY_EVENTS",                                            PR_FREEBUSY_BUSY_EVENTS                                              },
+	{ "PR_FREEBUSY_BUSY_MONTHS",                                            PR_FREEBUSY_BUSY_MONTHS                                              },
+	{ "PR_FREEBUSY_COUNT_MONTHS",                                           PR_FREEBUSY_COUNT_MONTHS                                             },
+	{ "PR_FREEBUSY_COUNT_MONTHS_ERROR",                                     PR_FREEBUSY_COUNT_MONTHS_ERROR                                       },
+	{ "PR_FREEBUSY_EMA",                                                    PR_FREEBUSY_EMA                                                      },
+	{ "PR_FREEBUSY_EMA_ERROR",                                              PR_FREEBUSY_EMA_ERROR                                                },
+	{ "PR_FREEBUSY_EMA_UNICODE",                                            PR_FREEBUSY_EMA_UNICODE                                              },
+	{ "PR_FREEBUSY_END_RANGE",                                              PR_FREEBUSY_END_RANGE                                                },
+	{ "PR_FREEBUSY_ENTRYIDS",                                               PR_FREEBUSY_ENTRYIDS                                                 },
+	{ "PR_FREEBUSY_ENTRYIDS_ERROR",                                         PR_FREEBUSY_ENTRYIDS_ERROR                                           },
+	{ "PR_FREEBUSY_LAST_MODIFIED",                                          PR_FREEBUSY_LAST_MODIFIED                                            },
+	{ "PR_FREEBUSY_OOF_EVENTS",                                             PR_FREEBUSY_OOF_EVENTS                                               },
+	{ "PR_FREEBUSY_OOF_MONTHS",                                             PR_FREEBUSY_OOF_MONTHS                                               },
+	{ "PR_FREEBUSY_PUBLISH_END",                                            PR_FREEBUSY_PUBLISH_END                                              },
+	{ "PR_FREEBUSY_PUBLISH_END_ERROR",                                      PR_FREEBUSY_PUBLISH_END_ERROR                                        },
+	{ "PR_FREEBUSY_PUBLISH_START",                                          PR_FREEBUSY_PUBLISH_START                                            },
+	{ "PR_FREEBUSY_PUBLISH_START_ERROR",                                    PR_FREEBUSY_PUBLISH_START_ERROR                                      },
+	{ "PR_FREEBUSY_RANGE_TIMESTAMP",                                        PR_FREEBUSY_RANGE_TIMESTAMP                                          },
+	{ "PR_FREEBUSY_RANGE_TIMESTAMP_ERROR",                                  PR_FREEBUSY_RANGE_TIMESTAMP_ERROR                                    },
+	{ "PR_FREEBUSY_START_RANGE",                                            PR_FREEBUSY_START_RANGE                                              },
+	{ "PR_FREEBUSY_TENTATIVE_EVENTS",                                       PR_FREEBUSY_TENTATIVE_EVENTS                                         },
+	{ "PR_FREEBUSY_TENTATIVE_MONTHS",                                       PR_FREEBUSY_TENTATIVE_MONTHS                                         },
+	{ "PR_FTP_SITE",                                                        PR_FTP_SITE                                                          },
+	{ "PR_FTP_SITE_ERROR",                                                  PR_FTP_SITE_ERROR                                                    },
+	{ "PR_FTP_SITE_UNICODE",                                                PR_FTP_SITE_UNICODE                                                  },
+	{ "PR_GATEWAY_NEEDS_TO_REFRESH",                                        PR_GATEWAY_NEEDS_TO_REFRESH                                          },
+	{ "PR_GATEWAY_NEEDS_TO_REFRESH_ERROR",                                  PR_GATEWAY_NEEDS_TO_REFRESH_ERROR                                    },
+	{ "PR_GENDER",                                                          PR_GENDER                                                            },
+	{ "PR_GENDER_ERROR",                                                    PR_GENDER_ERROR                                                      },
+	{ "PR_GENERATION",                                                      PR_GENERATION                                                        },
+	{ "PR_GENERATION_ERROR",                                                PR_GENERATION_ERROR                                                  },
+	{ "PR_GENERATION_UNICODE",                                              PR_GENERATION_UNICODE                                                },
+	{ "PR_GIVEN_NAME",                                                      PR_GIVEN_NAME                                                        },
+	{ "PR_GIVEN_NAME_ERROR",                                                PR_GIVEN_NAME_ERROR                                                  },
+	{ "PR_GIVEN_NAME_UNICODE",                                              PR_GIVEN_NAME_UNICODE                                                },
+	{ "PR_GOVERNMENT_ID_NUMBER",                                            PR_GOVERNMENT_ID_NUMBER                                              },
+	{ "PR_GOVERNMENT_ID_NUMBER_ERROR",                                      PR_GOVERNMENT_ID_NUMBER_ERROR                                        },
+	{ "PR_GOVERNMENT_ID_NUMBER_UNICODE",                                    PR_GOVERNMENT_ID_NUMBER_UNICODE                                      },
+	{ "PR_HASATTACH",                                                       PR_HASATTACH                                                         },
+	{ "PR_HASATTACH_ERROR",                                                 PR_HASATTACH_ERROR                                                   },
+	{ "PR_HAS_DAMS",                                                        PR_HAS_DAMS                                                          },
+	{ "PR_HAS_DAMS_ERROR",                                                  PR_HAS_DAMS_ERROR                                                    },
+	{ "PR_HAS_NAMED_PROPERTIES",                                            PR_HAS_NAMED_PROPERTIES                                              },
+	{ "PR_HAS_NAMED_PROPERTIES_ERROR",                                      PR_HAS_NAMED_PROPERTIES_ERROR                                        },
+	{ "PR_HAS_RULES",                                                       PR_HAS_RULES                                                         },
+	{ "PR_HAS_RULES_ERROR",                                                 PR_HAS_RULES_ERROR                                                   },
+	{ "PR_HIERARCHY_CHANGE_NUM",                                            PR_HIERARCHY_CHANGE_NUM                                              },
+	{ "PR_HIERARCHY_CHANGE_NUM_ERROR",                                      PR_HIERARCHY_CHANGE_NUM_ERROR                                        },
+	{ "PR_HOBBIES",                                                         PR_HOBBIES                                                           },
+	{ "PR_HOBBIES_ERROR",                                                   PR_HOBBIES_ERROR                                                     },
+	{ "PR_HOBBIES_UNICODE",                                                 PR_HOBBIES_UNICODE                                                   },
+	{ "PR_HOME2_TELEPHONE_NUMBER",                                          PR_HOME2_TELEPHONE_NUMBER                                            },
+	{ "PR_HOME2_TELEPHONE_NUMBER_A_MV",                                     PR_HOME2_TELEPHONE_NUMBER_A_MV                                       },
+	{ "PR_HOME2_TELEPHONE_NUMBER_A_MV_ERROR",                               PR_HOME2_TELEPHONE_NUMBER_A_MV_ERROR                                 },
+	{ "PR_HOME2_TELEPHONE_NUMBER_A_MV_UNICODE",                             PR_HOME2_TELEPHONE_NUMBER_A_MV_UNICODE                               },
+	{ "PR_HOME2_TELEPHONE_NUMBER_ERROR",                                    PR_HOME2_TELEPHONE_NUMBER_ERROR                                      },
+	{ "PR_HOME2_TELEPHONE_NUMBER_UNICODE",                                  PR_HOME2_TELEPHONE_NUMBER_UNICODE                                    },
+	{ "PR_HOME_ADDRESS_CITY",                                               PR_HOME_ADDRESS_CITY                                                 },
+	{ "PR_HOME_ADDRESS_CITY_ERROR",                                         PR_HOME_ADDRESS_CITY_ERROR                                           },
+	{ "PR_HOME_ADDRESS_CITY_UNICODE",                                       PR_HOME_ADDRESS_CITY_UNICODE                                         },
+	{ "PR_HOME_ADDRESS_COUNTRY",                                            PR_HOME_ADDRESS_COUNTRY                                              },
+	{ "PR_HOME_ADDRESS_COUNTRY_ERROR",                                      PR_HOME_ADDRESS_COUNTRY_ERROR                                        },
+	{ "PR_HOME_ADDRESS_COUNTRY_UNICODE",                                    PR_HOME_ADDRESS_COUNTRY_UNICODE                                      },
+	{ "PR_HOME_ADDRESS_POSTAL_CODE",                                        PR_HOME_ADDRESS_POSTAL_CODE                                          },
+	{ "PR_HOME_ADDRESS_POSTAL_CODE_ERROR",                                  PR_HOME_ADDRESS_POSTAL_CODE_ERROR                                    },
+	{ "PR_HOME_ADDRESS_POSTAL_CODE_UNICODE",                                PR_HOME_ADDRESS_POSTAL_CODE_UNICODE                                  },
+	{ "PR_HOME_ADDRESS_POST_OFFICE_BOX",                                    PR_HOME_ADDRESS_POST_OFFICE_BOX                                      },
+	{ "PR_HOME_ADDRESS_POST_OFFICE_BOX_ERROR",                              PR_HOME_ADDRESS_POST_OFFICE_BOX_ERROR                                },
+	{ "PR_HOME_ADDRESS_POST_OFFICE_BOX_UNICODE",                            PR_HOME_ADDRESS_POST_OFFICE_BOX_UNICODE                              },
+	{ "PR_HOME_ADDRESS_STATE_OR_PROVINCE",                                  PR_HOME_ADDRESS_STATE_OR_PROVINCE                                    },
+	{ "PR_HOME_ADDRESS_STATE_OR_PROVINCE_ERROR",                            PR_HOME_ADDRESS_STATE_OR_PROVINCE_ERROR                              },
+	{ "PR_HOME_ADDRESS_STATE_OR_PROVINCE_UNICODE",                          PR_HOME_ADDRESS_STATE_OR_PROVINCE_UNICODE                            },
+	{ "PR_HOME_ADDRESS_STREET",                                             PR_HOME_ADDRESS_STREET                                               },
+	{ "PR_HOME_ADDRESS_STREET_ERROR",                                       PR_HOME_ADDRESS_STREET_ERROR                                         },
+	{ "PR_HOME_ADDRESS_STREET_UNICODE",                                     PR_HOME_ADDRESS_STREET_UNICODE                                       },
+	{ "PR_HOME_FAX_NUMBER",                                                 PR_HOME_FAX_NUMBER                                                   },
+	{ "PR_HOME_FAX_NUMBER_ERROR",                                           PR_HOME_FAX_NUMBER_ERROR                                             },
+	{ "PR_HOME_FAX_NUMBER_UNICODE",                                         PR_HOME_FAX_NUMBER_UNICODE                                           },
+	{ "PR_HOME_TELEPHONE_NUMBER",                                           PR_HOME_TELEPHONE_NUMBER                                             },
+	{ "PR_HOME_TELEPHONE_NUMBER_ERROR",                                     PR_HOME_TELEPHONE_NUMBER_ERROR                                       },
+	{ "PR_HOME_TELEPHONE_NUMBER_UNICODE",                                   PR_HOME_TELEPHONE_NUMBER_UNICODE                                     },
+	{ "PR_HTML",                                                            PR_HTML                                                              },
+	{ "PR_HTML_ERROR",                                                      PR_HTML_ERROR                                                        },
+	{ "PR_ICON_INDEX",                                                      PR_ICON_INDEX                                                        },
+	{ "PR_ICON_INDEX_ERROR",                                                PR_ICON_INDEX_ERROR                                                  },
+	{ "PR_IMPORTANCE",                                                      PR_IMPORTANCE                                                        },
+	{ "PR_IMPORTANCE_ERROR",                                                PR_IMPORTANCE_ERROR                                                  },
+	{ "PR_INETMAIL_OVERRIDE_FORMAT",                                        PR_INETMAIL_OVERRIDE_FORMAT                                          },
+	{ "PR_INETMAIL_OVERRIDE_FORMAT_ERROR",                                  PR_INETMAIL_OVERRIDE_FORMAT_ERROR                                    },
+	{ "PR_INITIALS",                                                        PR_INITIALS                                                          },
+	{ "PR_INITIALS_ERROR",                                                  PR_INITIALS_ERROR                                                    },
+	{ "PR_INITIALS_UNICODE",                                                PR_INITIALS_UNICODE                                                  },
+	{ "PR_INITIAL_DETAILS_PANE",                                            PR_INITIAL_DETAILS_PANE                                              },
+	{ "PR_INITIAL_DETAILS_PANE_ERROR",                                      PR_INITIAL_DETAILS_PANE_ERROR                                        },
+	{ "PR_INSTANCE_KEY",                                                    PR_INSTANCE_KEY                                                      },
+	{ "PR_INSTANCE_KEY_ERROR",                                              PR_INSTANCE_KEY_ERROR                                                },
+	{ "PR_INSTANCE_NUM",                                                    PR_INSTANCE_NUM                                                      },
+	{ "PR_INST_ID",                                                         PR_INST_ID                                                           },
+	{ "PR_INTERNET_CPID",                                                   PR_INTERNET_CPID                                                     },
+	{ "PR_INTERNET_CPID_ERROR",                                             PR_INTERNET_CPID_ERROR                                               },
+	{ "PR_INTERNET_MESSAGE_ID",                                             PR_INTERNET_MESSAGE_ID                                               },
+	{ "PR_INTERNET_MESSAGE_ID_ERROR",                                       PR_INTERNET_MESSAGE_ID_ERROR                                         },
+	{ "PR_INTERNET_MESSAGE_ID_UNICODE",                                     PR_INTERNET_MESSAGE_ID_UNICODE                                       },
+	{ "PR_INTERNET_REFERENCES",                                             PR_INTERNET_REFERENCES                                               },
+	{ "PR_INTERNET_REFERENCES_ERROR",                                       PR_INTERNET_REFERENCES_ERROR                                         },
+	{ "PR_INTERNET_REFERENCES_UNICODE",                                     PR_INTERNET_REFERENCES_UNICODE                                       },
+	{ "PR_IN_CONFLICT",                                                     PR_IN_CONFLICT                                                       },
+	{ "PR_IN_CONFLICT_ERROR",                                               PR_IN_CONFLICT_ERROR                                                 },
+	{ "PR_IN_REPLY_TO_ID",                                                  PR_IN_REPLY_TO_ID                                                    },
+	{ "PR_IN_REPLY_TO_ID_ERROR",                                            PR_IN_REPLY_TO_ID_ERROR                                              },
+	{ "PR_IN_REPLY_TO_ID_UNICODE",                                          PR_IN_REPLY_TO_ID_UNICODE                                            },
+	{ "PR_IPM_APPOINTMENT_ENTRYID",                                         PR_IPM_APPOINTMENT_ENTRYID                                           },
+	{ "PR_IPM_APPOINTMENT_ENTRYID_ERROR",                                   PR_IPM_APPOINTMENT_ENTRYID_ERROR                                     },
+	{ "PR_IPM_CONTACT_ENTRYID",                                             PR_IPM_CONTACT_ENTRYID                                               },
+	{ "PR_IPM_CONTACT_ENTRYID_ERROR",                                       PR_IPM_CONTACT_ENTRYID_ERROR                                         },
+	{ "PR_IPM_DRAFTS_ENTRYID",                                              PR_IPM_DRAFTS_ENTRYID                                                },
+	{ "PR_IPM_DRAFTS_ENTRYID_ERROR",                                        PR_IPM_DRAFTS_ENTRYID_ERROR                                          },
+	{ "PR_IPM_JOURNAL_ENTRYID",                                             PR_IPM_JOURNAL_ENTRYID                                               },
+	{ "PR_IPM_JOURNAL_ENTRYID_ERROR",                                       PR_IPM_JOURNAL_ENTRYID_ERROR                                         },
+	{ "PR_IPM_NOTE_ENTRYID",                                                PR_IPM_NOTE_ENTRYID                                                  },
+	{ "PR_IPM_NOTE_ENTRYID_ERROR",                                          PR_IPM_NOTE_ENTRYID_ERROR                                            },
+	{ "PR_IPM_PUBLIC_FOLDERS_ENTRYID",                                      PR_IPM_PUBLIC_FOLDERS_ENTRYID                                        },
+	{ "PR_IPM_TASK_ENTRYID",                                                PR_IPM_TASK_ENTRYID                                                  },
+	{ "PR_IPM_TASK_ENTRYID_ERROR",                                          PR_IPM_TASK_ENTRYID_ERROR                                            },
+	{ "PR_ISDN_NUMBER",                                                     PR_ISDN_NUMBER                                                       },
+	{ "PR_ISDN_NUMBER_ERROR",                                               PR_ISDN_NUMBER_ERROR                                                 },
+	{ "PR_ISDN_NUMBER_UNICODE",                                             PR_ISDN_NUMBER_UNICODE                                               },
+	{ "PR_JUNK_ADD_RECIPS_TO_SSL",                                          PR_JUNK_ADD_RECIPS_TO_SSL                                            },
+	{ "PR_JUNK_ADD_RECIPS_TO_SSL_ERROR",                                    PR_JUNK_ADD_RECIPS_TO_SSL_ERROR                                      },
+	{ "PR_JUNK_INCLUDE_CONTACTS",                                           PR_JUNK_INCLUDE_CONTACTS                                             },
+	{ "PR_JUNK_INCLUDE_CONTACTS_ERROR",                                     PR_JUNK_INCLUDE_CONTACTS_ERROR                                       },
+	{ "PR_JUNK_PERMANENTLY_DELETE",                                         PR_JUNK_PERMANENTLY_DELETE                                           },
+	{ "PR_JUNK_PERMANENTLY_DELETE_ERROR",                                   PR_JUNK_PERMANENTLY_DELETE_ERROR                                     },
+	{ "PR_JUNK_PHISHING_ENABLE_LINKS",                                      PR_JUNK_PHISHING_ENABLE_LINKS                                        },
+	{ "PR_JUNK_PHISHING_ENABLE_LINKS_ERROR",                                PR_JUNK_PHISHING_ENABLE_LINKS_ERROR                                  },
+	{ "PR_JUNK_THRESHOLD",                                                  PR_JUNK_THRESHOLD                                                    },
+	{ "PR_JUNK_THRESHOLD_ERROR",                                            PR_JUNK_THRESHOLD_ERROR                                              },
+	{ "PR_KEYWORD",                                                         PR_KEYWORD                                                           },
+	{ "PR_KEYWORD_ERROR",                                                   PR_KEYWORD_ERROR                                                     },
+	{ "PR_KEYWORD_UNICODE",                                                 PR_KEYWORD_UNICODE                                                   },
+	{ "PR_LANGUAGE",                                                        PR_LANGUAGE                                                          },
+	{ "PR_LANGUAGE_ERROR",                                                  PR_LANGUAGE_ERROR                                                    },
+	{ "PR_LANGUAGE_UNICODE",                                                PR_LANGUAGE_UNICODE                                                  },
+	{ "PR_LAST_MODIFICATION_TIME",                                          PR_LAST_MODIFICATION_TIME                                            },
+	{ "PR_LAST_MODIFICATION_TIME_ERROR",                                    PR_LAST_MODIFICATION_TIME_ERROR                                      },
+	{ "PR_LAST_MODIFIER_ENTRYID",                                           PR_LAST_MODIFIER_ENTRYID                                             },
+	{ "PR_LAST_MODIFIER_ENTRYID_ERROR",                                     PR_LAST_MODIFIER_ENTRYID_ERROR                                       },
+	{ "PR_LAST_MODIFIER_NAME",                                              PR_LAST_MODIFIER_NAME                                                },
+	{ "PR_LAST_MODIFIER_NAME_ERROR",                                        PR_LAST_MODIFIER_NAME_ERROR                                          },
+	{ "PR_LAST_MODIFIER_NAME_UNICODE",                                      PR_LAST_MODIFIER_NAME_UNICODE                                        },
+	{ "PR_LAST_MODIFIER_SID",                                               PR_LAST_MODIFIER_SID                                                 },
+	{ "PR_LAST_VERB_EXECUTED",                                              PR_LAST_VERB_EXECUTED                                                },
+	{ "PR_LAST_VERB_EXECUTED_ERROR",                                        PR_LAST_VERB_EXECUTED_ERROR                                          },
+	{ "PR_LAST_VERB_EXECUTION_TIME",                                        PR_LAST_VERB_EXECUTION_TIME                                          },
+	{ "PR_LAST_VERB_EXECUTION_TIME_ERROR",                                  PR_LAST_VERB_EXECUTION_TIME_ERROR                                    },
+	{ "PR_LIST_HELP",                                                       PR_LIST_HELP                                                         },
+	{ "PR_LIST_HELP_ERROR",                                                 PR_LIST_HELP_ERROR                                                   },
+	{ "PR_LIST_HELP_UNICODE",                                               PR_LIST_HELP_UNICODE                                                 },
+	{ "PR_LIST_SUBSCRIBE",                                                  PR_LIST_SUBSCRIBE                                                    },
+	{ "PR_LIST_SUBSCRIBE_ERROR",                                            PR_LIST_SUBSCRIBE_ERROR                                              },
+	{ "PR_LIST_SUBSCRIBE_UNICODE",                                          PR_LIST_SUBSCRIBE_UNICODE                                            },
+	{ "PR_LIST_UNSUBSCRIBE",                                                PR_LIST_UNSUBSCRIBE                                                  },
+	{ "PR_LIST_UNSUBSCRIBE_ERROR",                                          PR_LIST_UNSUBSCRIBE_ERROR                                            },
+	{ "PR_LIST_UNSUBSCRIBE_UNICODE",                                        PR_LIST_UNSUBSCRIBE_UNICODE                                          },
+	{ "PR_LOCALE_ID",                                                       PR_LOCALE_ID                                                         },
+	{ "PR_LOCALE_ID_ERROR",                                                 PR_LOCALE_ID_ERROR                                                   },
+	{ "PR_LOCALITY",                                                        PR_LOCALITY                                                          },
+	{ "PR_LOCALITY_ERROR",                                                  PR_LOCALITY_ERROR                                                    },
+	{ "PR_LOCALITY_UNICODE",                                                PR_LOCALITY_UNICODE                                                  },
+	{ "PR_LOCAL_COMMIT_TIME",                                               PR_LOCAL_COMMIT_TIME                                                 },
+	{ "PR_LOCAL_COMMIT_TIME_ERROR",                                         PR_LOCAL_COMMIT_TIME_ERROR                                           },
+	{ "PR_LOCAL_COMMIT_TIME_MAX",                                           PR_LOCAL_COMMIT_TIME_MAX                                             },
+	{ "PR_LOCAL_COMMIT_TIME_MAX_ERROR",                                     PR_LOCAL_COMMIT_TIME_MAX_ERROR                                       },
+	{ "PR_LOCATION",                                                        PR_LOCATION                                                          },
+	{ "PR_LOCATION_ERROR",                                                  PR_LOCATION_ERROR                                                    },
+	{ "PR_LOCATION_UNICODE",                                                PR_LOCATION_UNICODE                                                  },
+	{ "PR_MAILBOX_OWNER_ENTRYID",                                           PR_MAILBOX_OWNER_ENTRYID                                             },
+	{ "PR_MAILBOX_OWNER_ENTRYID_ERROR",                                     PR_MAILBOX_OWNER_ENTRYID_ERROR                                       },
+	{ "PR_MAILBOX_OWNER_NAME",                                              PR_MAILBOX_OWNER_NAME                                                },
+	{ "PR_MAILBOX_OWNER_NAME_ERROR",                                        PR_MAILBOX_OWNER_NAME_ERROR                                          },
+	{ "PR_MAILBOX_OWNER_NAME_UNICODE",                                      PR_MAILBOX_OWNER_NAME_UNICODE                                        },
+	{ "PR_MANAGER_NAME",                                                    PR_MANAGER_NAME                                                      },
+	{ "PR_MANAGER_NAME_ERROR",                                              PR_MANAGER_NAME_ERROR                                                },
+	{ "PR_MANAGER_NAME_UNICODE",                                            PR_MANAGER_NAME_UNICODE                                              },
+	{ "PR_MAPPING_SIGNATURE",                                               PR_MAPPING_SIGNATURE                                                 },
+	{ "PR_MAPPING_SIGNATURE_ERROR",                                         PR_MAPPING_SIGNATURE_ERROR                                           },
+	{ "PR_MAX_SUBMIT_MESSAGE_SIZE",                                         PR_MAX_SUBMIT_MESSAGE_SIZE                                           },
+	{ "PR_MAX_SUBMIT_MESSAGE_SIZE_ERROR",                                   PR_MAX_SUBMIT_MESSAGE_SIZE_ERROR                                     },
+	{ "PR_MEMBER_ID",                                                       PR_MEMBER_ID                                                         },
+	{ "PR_MEMBER_ID_ERROR",                                                 PR_MEMBER_ID_ERROR                                                   },
+	{ "PR_MEMBER_NAME",                                                     PR_MEMBER_NAME                                                       },
+	{ "PR_MEMBER_NAME_ERROR",                                               PR_MEMBER_NAME_ERROR                                                 },
+	{ "PR_MEMBER_NAME_UNICODE",                                             PR_MEMBER_NAME_UNICODE                                               },
+	{ "PR_MEMBER_RIGHTS",                                                   PR_MEMBER_RIGHTS                                                     },
+	{ "PR_MEMBER_RIGHTS_ERROR",                                             PR_MEMBER_RIGHTS_ERROR                                               },
+	{ "PR_MESSAGE_ATTACHMENTS",                                             PR_MESSAGE_ATTACHMENTS                                               },
+	{ "PR_MESSAGE_ATTACHMENTS_ERROR",                                       PR_MESSAGE_ATTACHMENTS_ERROR                                         },
+	{ "PR_MESSAGE_CC_ME",                                                   PR_MESSAGE_CC_ME                                                     },
+	{ "PR_MESSAGE_CC_ME_ERROR",                                             PR_MESSAGE_CC_ME_ERROR                                               },
+	{ "PR_MESSAGE_CLASS",                                                   PR_MESSAGE_CLASS                                                     },
+	{ "PR_MESSAGE_CLASS_ERROR",                                             PR_MESSAGE_CLASS_ERROR                                               },
+	{ "PR_MESSAGE_CLASS_UNICODE",                                           PR_MESSAGE_CLASS_UNICODE                                             },
+	{ "PR_MESSAGE_CODEPAGE",                                                PR_MESSAGE_CODEPAGE                                                  },
+	{ "PR_MESSAGE_CODEPAGE_ERROR",                                          PR_MESSAGE_CODEPAGE_ERROR                                            },
+	{ "PR_MESSAGE_DELIVERY_TIME",                                           PR_MESSAGE_DELIVERY_TIME                                             },
+	{ "PR_MESSAGE_DELIVERY_TIME_ERROR",                                     PR_MESSAGE_DELIVERY_TIME_ERROR                                       },
+	{ "PR_MESSAGE_FLAGS",                                                   PR_MESSAGE_FLAGS                                                     },
+	{ "PR_MESSAGE_FLAGS_ERROR",                                             PR_MESSAGE_FLAGS_ERROR                                               },
+	{ "PR_MESSAGE_LOCALE_ID",                                               PR_MESSAGE_LOCALE_ID                                                 },
+	{ "PR_MESSAGE_LOCALE_ID_ERROR",                                         PR_MESSAGE_LOCALE_ID_ERROR                                           },
+	{ "PR_MESSAGE_RECIPIENTS",                                              PR_MESSAGE_RECIPIENTS                                                },
+	{ "PR_MESSAGE_RECIPIENTS_ERROR",                                        PR_MESSAGE_RECIPIENTS_ERROR                                          },
+	{ "PR_MESSAGE_RECIP_ME",                                                PR_MESSAGE_RECIP_ME                                                  },
+	{ "PR_MESSAGE_RECIP_ME_ERROR",                                          PR_MESSAGE_RECIP_ME_ERROR                                            },
+	{ "PR_MESSAGE_SIZE",                                                    PR_MESSAGE_SIZE                                                      },
+	{ "PR_MESSAGE_SIZE_ERROR",                                              PR_MESSAGE_SIZE_ERROR                                                },
+	{ "PR_MESSAGE_SIZE_EXTENDED",                                           PR_MESSAGE_SIZE_EXTENDED                                             },
+	{ "PR_MESSAGE_SIZE_EXTENDED_ERROR",                                     PR_MESSAGE_SIZE_EXTENDED_ERROR                                       },
+	{ "PR_MESSAGE_SUBMISSION_ID",                                           PR_MESSAGE_SUBMISSION_ID                                             },
+	{ "PR_MESSAGE_SUBMISSION_ID_ERROR",                                     PR_MESSAGE_SUBMISSION_ID_ERROR                                       },
+	{ "PR_MESSAGE_TO_ME",                                                   PR_MESSAGE_TO_ME                                                     },
+	{ "PR_MESSAGE_TO_ME_ERROR",                                             PR_MESSAGE_TO_ME_ERROR                                               },
+	{ "PR_MHS_COMMON_NAME",                                                 PR_MHS_COMMON_NAME                                                   },
+	{ "PR_MHS_COMMON_NAME_ERROR",                                           PR_MHS_COMMON_NAME_ERROR                                             },
+	{ "PR_MHS_COMMON_NAME_UNICODE",                                         PR_MHS_COMMON_NAME_UNICODE                                           },
+	{ "PR_MID",                                                             PR_MID                                                               },
+	{ "PR_MIDDLE_NAME",                                                     PR_MIDDLE_NAME                                                       },
+	{ "PR_MIDDLE_NAME_ERROR",                                               PR_MIDDLE_NAME_ERROR                                                 },
+	{ "PR_MIDDLE_NAME_UNICODE",                                             PR_MIDDLE_NAME_UNICODE                                               },
+	{ "PR_MOBILE_TELEPHONE_NUMBER",                                         PR_MOBILE_TELEPHONE_NUMBER                                           },
+	{ "PR_MOBILE_TELEPHONE_NUMBER_ERROR",                                   PR_MOBILE_TELEPHONE_NUMBER_ERROR                                     },
+	{ "PR_MOBILE_TELEPHONE_NUMBER_UNICODE",                                 PR_MOBILE_TELEPHONE_NUMBER_UNICODE                                   },
+	{ "PR_MSG_EDITOR_FORMAT",                                               PR_MSG_EDITOR_FORMAT                                                 },
+	{ "PR_MSG_EDITOR_FORMAT_ERROR",                                         PR_MSG_EDITOR_FORMAT_ERROR                                           },
+	{ "PR_MSG_STATUS",                                                      PR_MSG_STATUS                                                        },
+	{ "PR_MSG_STATUS_ERROR",                                                PR_MSG_STATUS_ERROR                                                  },
+	{ "PR_NATIVE_BODY_INFO",                                                PR_NATIVE_BODY_INFO                                                  },
+	{ "PR_NATIVE_BODY_INFO_ERROR",                                          PR_NATIVE_BODY_INFO_ERROR                                            },
+	{ "PR_NDR_DIAG_CODE",                                                   PR_NDR_DIAG_CODE                                                     },
+	{ "PR_NDR_DIAG_CODE_ERROR",                                             PR_NDR_DIAG_CODE_ERROR                                               },
+	{ "PR_NDR_REASON_CODE",                                                 PR_NDR_REASON_CODE                                                   },
+	{ "PR_NDR_REASON_CODE_ERROR",                                           PR_NDR_REASON_CODE_ERROR                                             },
+	{ "PR_NDR_STATUS_CODE",                                                 PR_NDR_STATUS_CODE                                                   },
+	{ "PR_NDR_STATUS_CODE_ERROR",                                           PR_NDR_STATUS_CODE_ERROR                                             },
+	{ "PR_NEXT_SEND_ACCT",                                                  PR_NEXT_SEND_ACCT                                                    },
+	{ "PR_NEXT_SEND_ACCT_ERROR",                                            PR_NEXT_SEND_ACCT_ERROR                                              },
+	{ "PR_NEXT_SEND_ACCT_UNICODE",                                          PR_NEXT_SEND_ACCT_UNICODE                                            },
+	{ "PR_NICKNAME",                                                        PR_NICKNAME                                                          },
+	{ "PR_NICKNAME_ERROR",                                                  PR_NICKNAME_ERROR                                                    },
+	{ "PR_NICKNAME_UNICODE",                                                PR_NICKNAME_UNICODE                                                  },
+	{ "PR_NORMALIZED_SUBJECT",                                              PR_NORMALIZED_SUBJECT                                                },
+	{ "PR_NORMALIZED_SUBJECT_ERROR",                                        PR_NORMALIZED_SUBJECT_ERROR                                          },
+	{ "PR_NORMALIZED_SUBJECT_UNICODE",                                      PR_NORMALIZED_SUBJECT_UNICODE                                        },
+	{ "PR_NORMAL_MESSAGE_SIZE",                                             PR_NORMAL_MESSAGE_SIZE                                               },
+	{ "PR_NTSD_MODIFICATION_TIME",                                          PR_NTSD_MODIFICATION_TIME                                            },
+	{ "PR_NT_SECURITY_DESCRIPTOR_AS_XML",                                   PR_NT_SECURITY_DESCRIPTOR_AS_XML                                     },
+	{ "PR_NT_SECURITY_DESCRIPTOR_AS_XML_ERROR",                             PR_NT_SECURITY_DESCRIPTOR_AS_XML_ERROR                               },
+	{ "PR_NT_SECURITY_DESCRIPTOR_AS_XML_UNICODE",                           PR_NT_SECURITY_DESCRIPTOR_AS_XML_UNICODE                             },
+	{ "PR_OAB_CONTAINER_GUID",                                              PR_OAB_CONTAINER_GUID                                                },
+	{ "PR_OAB_CONTAINER_GUID_ERROR",                                        PR_OAB_CONTAINER_GUID_ERROR                                          },
+	{ "PR_OAB_DN",                                                          PR_OAB_DN                                                            },
+	{ "PR_OAB_DN_ERROR",                                                    PR_OAB_DN_ERROR                                                      },
+	{ "PR_OAB_MESSAGE_CLASS",                                               PR_OAB_MESSAGE_CLASS                                                 },
+	{ "PR_OAB_MESSAGE_CLASS_ERROR",                                         PR_OAB_MESSAGE_CLASS_ERROR                                           },
+	{ "PR_OAB_NAME",                                                        PR_OAB_NAME                                                          },
+	{ "PR_OAB_NAME_ERROR",                                                  PR_OAB_NAME_ERROR                                                    },
+	{ "PR_OAB_NAME_UNICODE",                                                PR_OAB_NAME_UNICODE                                                  },
+	{ "PR_OAB_SEQUENCE",                                                    PR_OAB_SEQUENCE                                                      },
+	{ "PR_OAB_SEQUENCE_ERROR",                                              PR_OAB_SEQUENCE_ERROR                                                },
+	{ "PR_OAB_TRUNCATED_PROPS",                                             PR_OAB_TRUNCATED_PROPS                                               },
+	{ "PR_OAB_TRUNCATED_PROPS_ERROR",                                       PR_OAB_TRUNCATED_PROPS_ERROR                                         },
+	{ "PR_OBJECT_TYPE",                                                     PR_OBJECT_TYPE                                                       },
+	{ "PR_OBJECT_TYPE_ERROR",                                               PR_OBJECT_TYPE_ERROR                                                 },
+	{ "PR_OFFICE2_TELEPHONE_NUMBER",                                        PR_OFFICE2_TELEPHONE_NUMBER                                          },
+	{ "PR_OFFICE2_TELEPHONE_NUMBER_ERROR",                                  PR_OFFICE2_TELEPHONE_NUMBER_ERROR                                    },
+	{ "PR_OFFICE2_TELEPHONE_NUMBER_UNICODE",                                PR_OFFICE2_TELEPHONE_NUMBER_UNICODE                                  },
+	{ "PR_OFFICE_LOCATION",                                                 PR_OFFICE_LOCATION                                                   },
+	{ "PR_OFFICE_LOCATION_ERROR",                                           PR_OFFICE_LOCATION_ERROR                                             },
+	{ "PR_OFFICE_LOCATION_UNICODE",                                         PR_OFFICE_LOCATION_UNICODE                                           },
+	{ "PR_OFFICE_TELEPHONE_NUMBER",                                         PR_OFFICE_TELEPHONE_NUMBER                                           },
+	{ "PR_OFFICE_TELEPHONE_NUMBER_ERROR",                                   PR_OFFICE_TELEPHONE_NUMBER_ERROR                                     },
+	{ "PR_OFFICE_TELEPHONE_NUMBER_UNICODE",                                 PR_OFFICE_TELEPHONE_NUMBER_UNICODE                                   },
+	{ "PR_OOF_STATE",                                                       PR_OOF_STATE                                                         },
+	{ "PR_OOF_STATE_ERROR",                                                 PR_OOF_STATE_ERROR                                                   },
+	{ "PR_ORDINAL_MOST",                                                    PR_ORDINAL_MOST                                                      },
+	{ "PR_ORDINAL_MOST_ERROR",                                              PR_ORDINAL_MOST_ERROR                                                },
+	{ "PR_ORGANIZATIONAL_ID_NUMBER",                                        PR_ORGANIZATIONAL_ID_NUMBER                                          },
+	{ "PR_ORGANIZATIONAL_ID_NUMBER_ERROR",                                  PR_ORGANIZATIONAL_ID_NUMBER_ERROR                                    },
+	{ "PR_ORGANIZATIONAL_ID_NUMBER_UNICODE",                                PR_ORGANIZATIONAL_ID_NUMBER_UNICODE                                  },
+	{ "PR_ORIGINAL_AUTHOR_ENTRYID",                                         PR_ORIGINAL_AUTHOR_ENTRYID                                           },
+	{ "PR_ORIGINAL_AUTHOR_ENTRYID_ERROR",                                   PR_ORIGINAL_AUTHOR_ENTRYID_ERROR                                     },
+	{ "PR_ORIGINAL_DELIVERY_TIME",                                          PR_ORIGINAL_DELIVERY_TIME                                            },
+	{ "PR_ORIGINAL_DELIVERY_TIME_ERROR",                                    PR_ORIGINAL_DELIVERY_TIME_ERROR                                      },
+	{ "PR_ORIGINAL_DISPLAY_BCC",                                            PR_ORIGINAL_DISPLAY_BCC                                              },
+	{ "PR_ORIGINAL_DISPLAY_BCC_ERROR",                                      PR_ORIGINAL_DISPLAY_BCC_ERROR                                        },
+	{ "PR_ORIGINAL_DISPLAY_BCC_UNICODE",                                    PR_ORIGINAL_DISPLAY_BCC_UNICODE                                      },
+	{ "PR_ORIGINAL_DISPLAY_CC",                                             PR_ORIGINAL_DISPLAY_CC                                               },
+	{ "PR_ORIGINAL_DISPLAY_CC_ERROR",                                       PR_ORIGINAL_DISPLAY_CC_ERROR                                         },
+	{ "PR_ORIGINAL_DISPLAY_CC_UNICODE",                                     PR_ORIGINAL_DISPLAY_CC_UNICODE                                       },
+	{ "PR_ORIGINAL_DISPLAY_TO",                                             PR_ORIGINAL_DISPLAY_TO                                               },
+	{ "PR_ORIGINAL_DISPLAY_TO_ERROR",                                       PR_ORIGINAL_DISPLAY_TO_ERROR                                         },
+	{ "PR_ORIGINAL_DISPLAY_TO_UNICODE",                                     PR_ORIGINAL_DISPLAY_TO_UNICODE                                       },
+	{ "PR_ORIGINAL_ENTRYID",                                                PR_ORIGINAL_ENTRYID                                                  },
+	{ "PR_ORIGINAL_ENTRYID_ERROR",                                          PR_ORIGINAL_ENTRYID_ERROR                                            },
+	{ "PR_ORIGINAL_SENDER_ADDRTYPE",                                        PR_ORIGINAL_SENDER_ADDRTYPE                                          },
+	{ "PR_ORIGINAL_SENDER_ADDRTYPE_ERROR",                                  PR_ORIGINAL_SENDER_ADDRTYPE_ERROR                                    },
+	{ "PR_ORIGINAL_SENDER_ADDRTYPE_UNICODE",                                PR_ORIGINAL_SENDER_ADDRTYPE_UNICODE                                  },
+	{ "PR_ORIGINAL_SENDER_EMAIL_ADDRESS",                                   PR_ORIGINAL_SENDER_EMAIL_ADDRESS                                     },
+	{ "PR_ORIGINAL_SENDER_EMAIL_ADDRESS_ERROR",                             PR_ORIGINAL_SENDER_EMAIL_ADDRESS_ERROR                               },
+	{ "PR_ORIGINAL_SENDER_EMAIL_ADDRESS_UNICODE",                           PR_ORIGINAL_SENDER_EMAIL_ADDRESS_UNICODE                             },
+	{ "PR_ORIGINAL_SENDER_ENTRYID",                                         PR_ORIGINAL_SENDER_ENTRYID                                           },
+	{ "PR_ORIGINAL_SENDER_ENTRYID_ERROR",                                   PR_ORIGINAL_SENDER_ENTRYID_ERROR                                     },
+	{ "PR_ORIGINAL_SENDER_NAME",                                            PR_ORIGINAL_SENDER_NAME                                              },
+	{ "PR_ORIGINAL_SENDER_NAME_ERROR",                                      PR_ORIGINAL_SENDER_NAME_ERROR                                        },
+	{ "PR_ORIGINAL_SENDER_NAME_UNICODE",                                    PR_ORIGINAL_SENDER_NAME_UNICODE                                      },
+	{ "PR_ORIGINAL_SENDER_SEARCH_KEY",                                      PR_ORIGINAL_SENDER_SEARCH_KEY                                        },
+	{ "PR_ORIGINAL_SENDER_SEARCH_KEY_ERROR",                                PR_ORIGINAL_SENDER_SEARCH_KEY_ERROR                                  },
+	{ "PR_ORIGINAL_SENSITIVITY",                                            PR_ORIGINAL_SENSITIVITY                                              },
+	{ "PR_ORIGINAL_SENSITIVITY_ERROR",                                      PR_ORIGINAL_SENSITIVITY_ERROR                                        },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_ADDRTYPE",                             PR_ORIGINAL_SENT_REPRESENTING_ADDRTYPE                               },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_ADDRTYPE_ERROR",                       PR_ORIGINAL_SENT_REPRESENTING_ADDRTYPE_ERROR                         },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_ADDRTYPE_UNICODE",                     PR_ORIGINAL_SENT_REPRESENTING_ADDRTYPE_UNICODE                       },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_EMAIL_ADDRESS",                        PR_ORIGINAL_SENT_REPRESENTING_EMAIL_ADDRESS                          },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_EMAIL_ADDRESS_ERROR",                  PR_ORIGINAL_SENT_REPRESENTING_EMAIL_ADDRESS_ERROR                    },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_EMAIL_ADDRESS_UNICODE",                PR_ORIGINAL_SENT_REPRESENTING_EMAIL_ADDRESS_UNICODE                  },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_ENTRYID",                              PR_ORIGINAL_SENT_REPRESENTING_ENTRYID                                },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_ENTRYID_ERROR",                        PR_ORIGINAL_SENT_REPRESENTING_ENTRYID_ERROR                          },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_NAME",                                 PR_ORIGINAL_SENT_REPRESENTING_NAME                                   },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_NAME_ERROR",                           PR_ORIGINAL_SENT_REPRESENTING_NAME_ERROR                             },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_NAME_UNICODE",                         PR_ORIGINAL_SENT_REPRESENTING_NAME_UNICODE                           },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_SEARCH_KEY",                           PR_ORIGINAL_SENT_REPRESENTING_SEARCH_KEY                             },
+	{ "PR_ORIGINAL_SENT_REPRESENTING_SEARCH_KEY_ERROR",                     PR_ORIGINAL_SENT_REPRESENTING_SEARCH_KEY_ERROR                       },
+	{ "PR_ORIGINAL_SUBJECT",                                                PR_ORIGINAL_SUBJECT                                                  },
+	{ "PR_ORIGINAL_SUBJECT_ERROR",                                          PR_ORIGINAL_SUBJECT_ERROR                                            },
+	{ "PR_ORIGINAL_SUBJECT_UNICODE",                                        PR_ORIGINAL_SUBJECT_UNICODE                                          },
+	{ "PR_ORIGINAL_SUBMIT_TIME",                                            PR_ORIGINAL_SUBMIT_TIME                                              },
+	{ "PR_ORIGINAL_SUBMIT_TIME_ERROR",                                      PR_ORIGINAL_SUBMIT_TIME_ERROR                                        },
+	{ "PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED",                            PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED                              },
+	{ "PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED_ERROR",                      PR_ORIGINATOR_DELIVERY_REPORT_REQUESTED_ERROR                        },
+	{ "PR_ORIGINATOR_NON_DELIVERY_REPORT_REQUESTED",                        PR_ORIGINATOR_NON_DELIVERY_REPORT_REQUESTED                          },
+	{ "PR_ORIGINATOR_NON_DELIVERY_REPORT_REQUESTED_ERROR",                  PR_ORIGINATOR_NON_DELIVERY_REPORT_REQUESTED_ERROR                    },
+	{ "PR_ORIG_MESSAGE_CLASS",                                              PR_ORIG_MESSAGE_CLASS                                                },
+	{ "PR_ORIG_MESSAGE_CLASS_ERROR",                                        PR_ORIG_MESSAGE_CLASS_ERROR                                          },
+	{ "PR_ORIG_MESSAGE_CLASS_UNICODE",                                      PR_ORIG_MESSAGE_CLASS_UNICODE                                        },
+	{ "PR_OSC_SYNC_ENABLEDONSERVER",                                        PR_OSC_SYNC_ENABLEDONSERVER                                          },
+	{ "PR_OSC_SYNC_ENABLEDONSERVER_ERROR",                                  PR_OSC_SYNC_ENABLEDONSERVER_ERROR                                    },
+	{ "PR_OTHER_ADDRESS_CITY",                                              PR_OTHER_ADDRESS_CITY                                                },
+	{ "PR_OTHER_ADDRESS_CITY_ERROR",                                        PR_OTHER_ADDRESS_CITY_ERROR                                          },
+	{ "PR_OTHER_ADDRESS_CITY_UNICODE",                                      PR_OTHER_ADDRESS_CITY_UNICODE                                        },
+	{ "PR_OTHER_ADDRESS_COUNTRY",                                           PR_OTHER_ADDRESS_COUNTRY                                             },
+	{ "PR_OTHER_ADDRESS_COUNTRY_ERROR",                                     PR_OTHER_ADDRESS_COUNTRY_ERROR                                       },
+	{ "PR_OTHER_ADDRESS_COUNTRY_UNICODE",                                   PR_OTHER_ADDRESS_COUNTRY_UNICODE                                     },
+	{ "PR_OTHER_ADDRESS_POSTAL_CODE",                                       PR_OTHER_ADDRESS_POSTAL_CODE                                         },
+	{ "PR_OTHER_ADDRESS_POSTAL_CODE_ERROR",                                 PR_OTHER_ADDRESS_POSTAL_CODE_ERROR                                   },
+	{ "PR_OTHER_ADDRESS_POSTAL_CODE_UNICODE",                               PR_OTHER_ADDRESS_POSTAL_CODE_UNICODE                                 },
+	{ "PR_OTHER_ADDRESS_POST_OFFICE_BOX",                                   PR_OTHER_ADDRESS_POST_OFFICE_BOX                                     },
+	{ "PR_OTHER_ADDRESS_POST_OFFICE_BOX_ERROR",                             PR_OTHER_ADDRESS_POST_OFFICE_BOX_ERROR                               },
+	{ "PR_OTHER_ADDRESS_POST_OFFICE_BOX_UNICODE",                           PR_OTHER_ADDRESS_POST_OFFICE_BOX_UNICODE                             },
+	{ "PR_OTHER_ADDRESS_STATE_OR_PROVINCE",                                 PR_OTHER_ADDRESS_STATE_OR_PROVINCE                                   },
+	{ "PR_OTHER_ADDRESS_STATE_OR_PROVINCE_ERROR",                           PR_OTHER_ADDRESS_STATE_OR_PROVINCE_ERROR                             },
+	{ "PR_OTHER_ADDRESS_STATE_OR_PROVINCE_UNICODE",                         PR_OTHER_ADDRESS_STATE_OR_PROVINCE_UNICODE                           },
+	{ "PR_OTHER_ADDRESS_STREET",                                            PR_OTHER_ADDRESS_STREET                                              },
+	{ "PR_OTHER_ADDRESS_STREET_ERROR",                                      PR_OTHER_ADDRESS_STREET_ERROR                                        },
+	{ "PR_OTHER_ADDRESS_STREET_UNICODE",                                    PR_OTHER_ADDRESS_STREET_UNICODE                                      },
+	{ "PR_OTHER_TELEPHONE_NUMBER",                                          PR_OTHER_TELEPHONE_NUMBER                                            },
+	{ "PR_OTHER_TELEPHONE_NUMBER_ERROR",                                    PR_OTHER_TELEPHONE_NUMBER_ERROR                                      },
+	{ "PR_OTHER_TELEPHONE_NUMBER_UNICODE",                                  PR_OTHER_TELEPHONE_NUMBER_UNICODE                                    },
+	{ "PR_OWNER_APPT_ID",                                                   PR_OWNER_APPT_ID                                                     },
+	{ "PR_OWNER_APPT_ID_ERROR",                                             PR_OWNER_APPT_ID_ERROR                                               },
+	{ "PR_PAGER_TELEPHONE_NUMBER",                                          PR_PAGER_TELEPHONE_NUMBER                                            },
+	{ "PR_PAGER_TELEPHONE_NUMBER_ERROR",                                    PR_PAGER_TELEPHONE_NUMBER_ERROR                                      },
+	{ "PR_PAGER_TELEPHONE_NUMBER_UNICODE",                                  PR_PAGER_TELEPHONE_NUMBER_UNICODE                                    },
+	{ "PR_PARENT_ENTRYID",                                                  PR_PARENT_ENTRYID                                                    },
+	{ "PR_PARENT_ENTRYID_ERROR",                                            PR_PARENT_ENTRYID_ERROR                                              },
+	{ "PR_PARENT_FID",                                                      PR_PARENT_FID                                                        },
+	{ "PR_PARENT_KEY",                                                      PR_PARENT_KEY                                                        },
+	{ "PR_PARENT_KEY_ERROR",                                                PR_PARENT_KEY_ERROR                                                  },
+	{ "PR_PARENT_SOURCE_KEY",                                               PR_PARENT_SOURCE_KEY                                                 },
+	{ "PR_PARENT_SOURCE_KEY_ERROR",                                         PR_PARENT_SOURCE_KEY_ERROR                                           },
+	{ "PR_PERSONAL_HOME_PAGE",                                              PR_PERSONAL_HOME_PAGE                                                },
+	{ "PR_PERSONAL_HOME_PAGE_ERROR",                                        PR_PERSONAL_HOME_PAGE_ERROR                                          },
+	{ "PR_PERSONAL_HOME_PAGE_UNICODE",                                      PR_PERSONAL_HOME_PAGE_UNICODE                                        },
+	{ "PR_POLICY_TAG",                                                      PR_POLICY_TAG                                                        },
+	{ "PR_POLICY_TAG_ERROR",                                                PR_POLICY_TAG_ERROR                                                  },
+	{ "PR_POSTAL_ADDRESS",                                                  PR_POSTAL_ADDRESS                                                    },
+	{ "PR_POSTAL_ADDRESS_ERROR",                                            PR_POSTAL_ADDRESS_ERROR                                              },
+	{ "PR_POSTAL_ADDRESS_UNICODE",                                          PR_POSTAL_ADDRESS_UNICODE                                            },
+	{ "PR_POSTAL_CODE",                                                     PR_POSTAL_CODE                                                       },
+	{ "PR_POSTAL_CODE_ERROR",                                               PR_POSTAL_CODE_ERROR                                                 },
+	{ "PR_POSTAL_CODE_UNICODE",                                             PR_POSTAL_CODE_UNICODE                                               },
+	{ "PR_POST_OFFICE_BOX",                                                 PR_POST_OFFICE_BOX                                                   },
+	{ "PR_POST_OFFICE_BOX_ERROR",                                           PR_POST_OFFICE_BOX_ERROR                                             },
+	{ "PR_POST_OFFICE_BOX_UNICODE",                                         PR_POST_OFFICE_BOX_UNICODE                                           },
+	{ "PR_PREDECESSOR_CHANGE_LIST",                                         PR_PREDECESSOR_CHANGE_LIST                                           },
+	{ "PR_PREDECESSOR_CHANGE_LIST_ERROR",                                   PR_PREDECESSOR_CHANGE_LIST_ERROR                                     },
+	{ "PR_PRIMARY_FAX_NUMBER",                                              PR_PRIMARY_FAX_NUMBER                                                },
+	{ "PR_PRIMARY_FAX_NUMBER_ERROR",                                        PR_PRIMARY_FAX_NUMBER_ERROR                                          },
+	{ "PR_PRIMARY_FAX_NUMBER_UNICODE",                                      PR_PRIMARY_FAX_NUMBER_UNICODE                                        },
+	{ "PR_PRIMARY_SEND_ACCT",                                               PR_PRIMARY_SEND_ACCT                                                 },
+	{ "PR_PRIMARY_SEND_ACCT_ERROR",                                         PR_PRIMARY_SEND_ACCT_ERROR                                           },
+	{ "PR_PRIMARY_SEND_ACCT_UNICODE",                                       PR_PRIMARY_SEND_ACCT_UNICODE                                         },
+	{ "PR_PRIMARY_TELEPHONE_NUMBER",                                        PR_PRIMARY_TELEPHONE_NUMBER                                          },
+	{ "PR_PRIMARY_TELEPHONE_NUMBER_ERROR",                                  PR_PRIMARY_TELEPHONE_NUMBER_ERROR                                    },
+	{ "PR_PRIMARY_TELEPHONE_NUMBER_UNICODE",                                PR_PRIMARY_TELEPHONE_NUMBER_UNICODE                                  },
+	{ "PR_PRIORITY",                                                        PR_PRIORITY                                                          },
+	{ "PR_PRIORITY_ERROR",                                                  PR_PRIORITY_ERROR                                                    },
+	{ "PR_PROCESSED",                                                       PR_PROCESSED                                                         },
+	{ "PR_PROCESSED_ERROR",                                                 PR_PROCESSED_ERROR                                                   },
+	{ "PR_PROFESSION",                                                      PR_PROFESSION                                                        },
+	{ "PR_PROFESSION_ERROR",                                                PR_PROFESSION_ERROR                                                  },
+	{ "PR_PROFESSION_UNICODE",                                              PR_PROFESSION_UNICODE                                                },
+	{ "PR_PROFILE_HOME_SERVER_ADDRS",                                       PR_PROFILE_HOME_SERVER_ADDRS                                         },
+	{ "PR_PROHIBIT_RECEIVE_QUOTA",                                          PR_PROHIBIT_RECEIVE_QUOTA                                            },
+	{ "PR_PROHIBIT_RECEIVE_QUOTA_ERROR",                                    PR_PROHIBIT_RECEIVE_QUOTA_ERROR                                      },
+	{ "PR_PROHIBIT_SEND_QUOTA",                                             PR_PROHIBIT_SEND_QUOTA                                               },
+	{ "PR_PROHIBIT_SEND_QUOTA_ERROR",                                       PR_PROHIBIT_SEND_QUOTA_ERROR                                         },
+	{ "PR_PURPORTED_SENDER_DOMAIN",                                         PR_PURPORTED_SENDER_DOMAIN                                           },
+	{ "PR_PURPORTED_SENDER_DOMAIN_ERROR",                                   PR_PURPORTED_SENDER_DOMAIN_ERROR                                     },
+	{ "PR_PURPORTED_SENDER_DOMAIN_UNICODE",                                 PR_PURPORTED_SENDER_DOMAIN_UNICODE                                   },
+	{ "PR_RADIO_TELEPHONE_NUMBER",                                          PR_RADIO_TELEPHONE_NUMBER                                            },
+	{ "PR_RADIO_TELEPHONE_NUMBER_ERROR",                                    PR_RADIO_TELEPHONE_NUMBER_ERROR                                      },
+	{ "PR_RADIO_TELEPHONE_NUMBER_UNICODE",                                  PR_RADIO_TELEPHONE_NUMBER_UNICODE                                    },
+	{ "PR_RCVD_REPRESENTING_ADDRTYPE",                                      PR_RCVD_REPRESENTING_ADDRTYPE                                        },
+	{ "PR_RCVD_REPRESENTING_ADDRTYPE_ERROR",                                PR_RCVD_REPRESENTING_ADDRTYPE_ERROR                                  },
+	{ "PR_RCVD_REPRESENTING_ADDRTYPE_UNICODE",                              PR_RCVD_REPRESENTING_ADDRTYPE_UNICODE                                },
+	{ "PR_RCVD_REPRESENTING_EMAIL_ADDRESS",                                 PR_RCVD_REPRESENTING_EMAIL_ADDRESS                                   },
+	{ "PR_RCVD_REPRESENTING_EMAIL_ADDRESS_ERROR",                           PR_RCVD_REPRESENTING_EMAIL_ADDRESS_ERROR                             },
+	{ "PR_RCVD_REPRESENTING_EMAIL_ADDRESS_UNICODE",                         PR_RCVD_REPRESENTING_EMAIL_ADDRESS_UNICODE                           },
+	{ "PR_RCVD_REPRESENTING_ENTRYID",                                       PR_RCVD_REPRESENTING_ENTRYID                                         },
+	{ "PR_RCVD_REPRESENTING_ENTRYID_ERROR",                                 PR_RCVD_REPRESENTING_ENTRYID_ERROR                                   },
+	{ "PR_RCVD_REPRESENTING_NAME",                                          PR_RCVD_REPRESENTING_NAME                                            },
+	{ "PR_RCVD_REPRESENTING_NAME_ERROR",                                    PR_RCVD_REPRESENTING_NAME_ERROR                                      },
+	{ "PR_RCVD_REPRESENTING_NAME_UNICODE",                                  PR_RCVD_REPRESENTING_NAME_UNICODE                                    },
+	{ "PR_RCVD_REPRESENTING_SEARCH_KEY",                                    PR_RCVD_REPRESENTING_SEARCH_KEY                                      },
+	{ "PR_RCVD_REPRESENTING_SEARCH_KEY_ERROR",                              PR_RCVD_REPRESENTING_SEARCH_KEY_ERROR                                },
+	{ "PR_READ",                                                            PR_READ                                                              },
+	{ "PR_READ_ERROR",                                                      PR_READ_ERROR                                                        },
+	{ "PR_READ_RECEIPT_ENTRYID",                                            PR_READ_RECEIPT_ENTRYID                                              },
+	{ "PR_READ_RECEIPT_ENTRYID_ERROR",                                      PR_READ_RECEIPT_ENTRYID_ERROR                                        },
+	{ "PR_READ_RECEIPT_REQUESTED",                                          PR_READ_RECEIPT_REQUESTED                                            },
+	{ "PR_READ_RECEIPT_REQUESTED_ERROR",                                    PR_READ_RECEIPT_REQUESTED_ERROR                                      },
+	{ "PR_READ_RECEIPT_SEARCH_KEY",                                         PR_READ_RECEIPT_SEARCH_KEY                                           },
+	{ "PR_READ_RECEIPT_SEARCH_KEY_ERROR",                                   PR_READ_RECEIPT_SEARCH_KEY_ERROR                                     },
+	{ "PR_RECEIPT_TIME",                                                    PR_RECEIPT_TIME                                                      },
+	{ "PR_RECEIPT_TIME_ERROR",                                              PR_RECEIPT_TIME_ERROR                                                },
+	{ "PR_RECEIVED_BY_ADDRTYPE",                                            PR_RECEIVED_BY_ADDRTYPE                                              },
+	{ "PR_RECEIVED_BY_ADDRTYPE_ERROR",                                      PR_RECEIVED_BY_ADDRTYPE_ERROR                                        },
+	{ "PR_RECEIVED_BY_ADDRTYPE_UNICODE",                                    PR_RECEIVED_BY_ADDRTYPE_UNICODE                                      },
+	{ "PR_RECEIVED_BY_EMAIL_ADDRESS",                                       PR_RECEIVED_BY_EMAIL_ADDRESS                                         },
+	{ "PR_RECEIVED_BY_EMAIL_ADDRESS_ERROR",                                 PR_RECEIVED_BY_EMAIL_ADDRESS_ERROR                                   },
+	{ "PR_RECEIVED_BY_EMAIL_ADDRESS_UNICODE",                               PR_RECEIVED_BY_EMAIL_ADDRESS_UNICODE                                 },
+	{ "PR_RECEIVED_BY_ENTRYID",                                             PR_RECEIVED_BY_ENTRYID                                               },
+	{ "PR_RECEIVED_BY_ENTRYID_ERROR",                                       PR_RECEIVED_BY_ENTRYID_ERROR                                         },
+	{ "PR_RECEIVED_BY_NAME",                                                PR_RECEIVED_BY_NAME                                                  },
+	{ "PR_RECEIVED_BY_NAME_ERROR",                                          PR_RECEIVED_BY_NAME_ERROR                                            },
+	{ "PR_RECEIVED_BY_NAME_UNICODE",                                        PR_RECEIVED_BY_NAME_UNICODE                                          },
+	{ "PR_RECEIVED_BY_SEARCH_KEY",                                          PR_RECEIVED_BY_SEARCH_KEY                                            },
+	{ "PR_RECEIVED_BY_SEARCH_KEY_ERROR",                                    PR_RECEIVED_BY_SEARCH_KEY_ERROR                                      },
+	{ "PR_RECIPIENT_DISPLAY_NAME",                                          PR_RECIPIENT_DISPLAY_NAME                                            },
+	{ "PR_RECIPIENT_DISPLAY_NAME_ERROR",                                    PR_RECIPIENT_DISPLAY_NAME_ERROR                                      },
+	{ "PR_RECIPIENT_DISPLAY_NAME_UNICODE",                                  PR_RECIPIENT_DISPLAY_NAME_UNICODE                                    },
+	{ "PR_RECIPIENT_ENTRYID",                                               PR_RECIPIENT_ENTRYID                                                 },
+	{ "PR_RECIPIENT_ENTRYID_ERROR",                                         PR_RECIPIENT_ENTRYID_ERROR                                           },
+	{ "PR_RECIPIENT_FLAGS",                                                 PR_RECIPIENT_FLAGS                                                   },
+	{ "PR_RECIPIENT_FLAGS_ERROR",                                           PR_RECIPIENT_FLAGS_ERROR                                             },
+	{ "PR_RECIPIENT_ON_NORMAL_MSG_COUNT",                                   PR_RECIPIENT_ON_NORMAL_MSG_COUNT                                     },
+	{ "PR_RECIPIENT_ORDER",                                                 PR_RECIPIENT_ORDER                                                   },
+	{ "PR_RECIPIENT_ORDER_ERROR",                                           PR_RECIPIENT_ORDER_ERROR                                             },
+	{ "PR_RECIPIENT_PROPOSED",                                              PR_RECIPIENT_PROPOSED                                                },
+	{ "PR_RECIPIENT_PROPOSEDENDTIME",                                       PR_RECIPIENT_PROPOSEDENDTIME                                         },
+	{ "PR_RECIPIENT_PROPOSEDENDTIME_ERROR",                                 PR_RECIPIENT_PROPOSEDENDTIME_ERROR                                   },
+	{ "PR_RECIPIENT_PROPOSEDSTARTTIME",                                     PR_RECIPIENT_PROPOSEDSTARTTIME                                       },
+	{ "PR_RECIPIENT_PROPOSEDSTARTTIME_ERROR",                               PR_RECIPIENT_PROPOSEDSTARTTIME_ERROR                                 },
+	{ "PR_RECIPIENT_PROPOSED_ERROR",                                        PR_RECIPIENT_PROPOSED_ERROR                                          },
+	{ "PR_RECIPIENT_REASSIGNMENT_PROHIBITED",                               PR_RECIPIENT_REASSIGNMENT_PROHIBITED                                 },
+	{ "PR_RECIPIENT_REASSIGNMENT_PROHIBITED_ERROR",                         PR_RECIPIENT_REASSIGNMENT_PROHIBITED_ERROR                           },
+	{ "PR_RECIPIENT_TRACKSTATUS",                                           PR_RECIPIENT_TRACKSTATUS                                             },
+	{ "PR_RECIPIENT_TRACKSTATUS_ERROR",                                     PR_RECIPIENT_TRACKSTATUS_ERROR                                       },
+	{ "PR_RECIPIENT_TRACKSTATUS_TIME",                                      PR_RECIPIENT_TRACKSTATUS_TIME                                        },
+	{ "PR_RECIPIENT_TRACKSTATUS_TIME_ERROR",                                PR_RECIPIENT_TRACKSTATUS_TIME_ERROR                                  },
+	{ "PR_RECIPIENT_TYPE",                                                  PR_RECIPIENT_TYPE                                                    },
+	{ "PR_RECIPIENT_TYPE_ERROR",                                            PR_RECIPIENT_TYPE_ERROR                                              },
+	{ "PR_RECORD_KEY",                                                      PR_RECORD_KEY                                                        },
+	{ "PR_RECORD_KEY_ERROR",                                                PR_RECORD_KEY_ERROR                                                  },
+	{ "PR_REFERRED_BY_NAME",                                                PR_REFERRED_BY_NAME                                                  },
+	{ "PR_REFERRED_BY_NAME_ERROR",                                          PR_REFERRED_BY_NAME_ERROR                                            },
+	{ "PR_REFERRED_BY_NAME_UNICODE",                                        PR_REFERRED_BY_NAME_UNICODE                                          },
+	{ "PR_REMINDERS_ONLINE_ENTRYID",                                        PR_REMINDERS_ONLINE_ENTRYID                                          },
+	{ "PR_REM_ONLINE_ENTRYID",                                              PR_REM_ONLINE_ENTRYID                                                },
+	{ "PR_REM_ONLINE_ENTRYID_ERROR",                                        PR_REM_ONLINE_ENTRYID_ERROR                                          },
+	{ "PR_RENDERING_POSITION",                                              PR_RENDERING_POSITION                                                },
+	{ "PR_RENDERING_POSITION_ERROR",                                        PR_RENDERING_POSITION_ERROR                                          },
+	{ "PR_REPLY_RECIPIENT_ENTRIES",                                         PR_REPLY_RECIPIENT_ENTRIES                                           },
+	{ "PR_REPLY_RECIPIENT_ENTRIES_ERROR",                                   PR_REPLY_RECIPIENT_ENTRIES_ERROR                                     },
+	{ "PR_REPLY_RECIPIENT_NAMES",                                           PR_REPLY_RECIPIENT_NAMES                                             },
+	{ "PR_REPLY_RECIPIENT_NAMES_ERROR",                                     PR_REPLY_RECIPIENT_NAMES_ERROR                                       },
+	{ "PR_REPLY_RECIPIENT_NAMES_UNICODE",                                   PR_REPLY_RECIPIENT_NAMES_UNICODE                                     },
+	{ "PR_REPLY_REQUESTED",                                                 PR_REPLY_REQUESTED                                                   },
+	{ "PR_REPLY_REQUESTED_ERROR",                                           PR_REPLY_REQUESTED_ERROR                                             },
+	{ "PR_REPLY_TEMPLATE_ID",                                               PR_REPLY_TEMPLATE_ID                                                 },
+	{ "PR_REPLY_TEMPLATE_ID_ERROR",                                         PR_REPLY_TEMPLATE_ID_ERROR                                           },
+	{ "PR_REPLY_TIME",                                                      PR_REPLY_TIME                                                        },
+	{ "PR_REPLY_TIME_ERROR",                                                PR_REPLY_TIME_ERROR                                                  },
+	{ "PR_REPORT_ENTRYID",                                                  PR_REPORT_ENTRYID                                                    },
+	{ "PR_REPORT_ENTRYID_ERROR",                                            PR_REPORT_ENTRYID_ERROR                                              },
+	{ "PR_REPORT_NAME",                                                     PR_REPORT_NAME                                                       },
+	{ "PR_REPORT_NAME_ERROR",                                               PR_REPORT_NAME_ERROR                                                 },
+	{ "PR_REPORT_NAME_UNICODE",                                             PR_REPORT_NAME_UNICODE                                               },
+	{ "PR_REPORT_SEARCH_KEY",                                               PR_REPORT_SEARCH_KEY                                                 },
+	{ "PR_REPORT_SEARCH_KEY_ERROR",                                         PR_REPORT_SEARCH_KEY_ERROR                                           },
+	{ "PR_REPORT_TAG",                                                      PR_REPORT_TAG                                                        },
+	{ "PR_REPORT_TAG_ERROR",                                                PR_REPORT_TAG_ERROR                                                  },
+	{ "PR_REPORT_TEXT",                                                     PR_REPORT_TEXT                                                       },
+	{ "PR_REPORT_TEXT_ERROR",                                               PR_REPORT_TEXT_ERROR                                                 },
+	{ "PR_REPORT_TEXT_UNICODE",                                             PR_REPORT_TEXT_UNICODE                                               },
+	{ "PR_REPORT_TIME",                                                     PR_REPORT_TIME                                                       },
+	{ "PR_REPORT_TIME_ERROR",                                               PR_REPORT_TIME_ERROR                                                 },
+	{ "PR_RESOLVE_METHOD",                                                  PR_RESOLVE_METHOD                                                    },
+	{ "PR_RESOLVE_METHOD_ERROR",                                            PR_RESOLVE_METHOD_ERROR                                              },
+	{ "PR_RESPONSE_REQUESTED",                                              PR_RESPONSE_REQUESTED                                                },
+	{ "PR_RESPONSE_REQUESTED_ERROR",                                        PR_RESPONSE_REQUESTED_ERROR                                          },
+	{ "PR_RESPONSIBILITY",                                                  PR_RESPONSIBILITY                                                    },
+	{ "PR_RESPONSIBILITY_ERROR",                                            PR_RESPONSIBILITY_ERROR                                              },
+	{ "PR_RETENTION_DATE",                                                  PR_RETENTION_DATE                                                    },
+	{ "PR_RETENTION_DATE_ERROR",                                            PR_RETENTION_DATE_ERROR                                              },
+	{ "PR_RETENTION_FLAGS",                                                 PR_RETENTION_FLAGS                                                   },
+	{ "PR_RETENTION_FLAGS_ERROR",                                           PR_RETENTION_FLAGS_ERROR                                             },
+	{ "PR_RETENTION_PERIOD",                                                PR_RETENTION_PERIOD                                                  },
+	{ "PR_RETENTION_PERIOD_ERROR",                                          PR_RETENTION_PERIOD_ERROR                                            },
+	{ "PR_RIGHTS",                                                          PR_RIGHTS                                                            },
+	{ "PR_RIGHTS_ERROR",                                                    PR_RIGHTS_ERROR                                                      },
+	{ "PR_ROAMING_DATATYPES",                                               PR_ROAMING_DATATYPES                                                 },
+	{ "PR_ROAMING_DATATYPES_ERROR",                                         PR_ROAMING_DATATYPES_ERROR                                           },
+	{ "PR_ROAMING_DICTIONARY",                                              PR_ROAMING_DICTIONARY                                                },
+	{ "PR_ROAMING_DICTIONARY_ERROR",                                        PR_ROAMING_DICTIONARY_ERROR                                          },
+	{ "PR_ROAMING_XMLSTREAM",                                               PR_ROAMING_XMLSTREAM                                                 },
+	{ "PR_ROAMING_XMLSTREAM_ERROR",                                         PR_ROAMING_XMLSTREAM_ERROR                                           },
+	{ "PR_ROWID",                                                           PR_ROWID                                                             },
+	{ "PR_ROWID_ERROR",                                                     PR_ROWID_ERROR                                                       },
+	{ "PR_ROW_TYPE",                                                        PR_ROW_TYPE                                                          },
+	{ "PR_ROW_TYPE_ERROR",                                                  PR_ROW_TYPE_ERROR                                                    },
+	{ "PR_RTF_COMPRESSED",                                                  PR_RTF_COMPRESSED                                                    },
+	{ "PR_RTF_COMPRESSED_ERROR",                                            PR_RTF_COMPRESSED_ERROR                                              },
+	{ "PR_RTF_IN_SYNC",                                                     PR_RTF_IN_SYNC                                                       },
+	{ "PR_RTF_IN_SYNC_ERROR",                                               PR_RTF_IN_SYNC_ERROR                                                 },
+	{ "PR_RULE_ACTIONS",                                                    PR_RULE_ACTIONS                                                      },
+	{ "PR_RULE_ACTIONS_ERROR",                                              PR_RULE_ACTIONS_ERROR                                                },
+	{ "PR_RULE_ACTION_NUMBER",                                              PR_RULE_ACTION_NUMBER                                                },
+	{ "PR_RULE_ACTION_NUMBER_ERROR",                                        PR_RULE_ACTION_NUMBER_ERROR                                          },
+	{ "PR_RULE_ACTION_TYPE",                                                PR_RULE_ACTION_TYPE                                                  },
+	{ "PR_RULE_ACTION_TYPE_ERROR",                                          PR_RULE_ACTION_TYPE_ERROR                                            },
+	{ "PR_RULE_CONDITION",                                                  PR_RULE_CONDITION                                                    },
+	{ "PR_RULE_CONDITION_ERROR",                                            PR_RULE_CONDITION_ERROR                                              },
+	{ "PR_RULE_ERROR",                                                      PR_RULE_ERROR                                                        },
+	{ "PR_RULE_ERROR_ERROR",                                                PR_RULE_ERROR_ERROR                                                  },
+	{ "PR_RULE_FOLDER_ENTRYID",                                             PR_RULE_FOLDER_ENTRYID                                               },
+	{ "PR_RULE_FOLDER_ENTRYID_ERROR",                                       PR_RULE_FOLDER_ENTRYID_ERROR                                         },
+	{ "PR_RULE_ID",                                                         PR_RULE_ID                                                           },
+	{ "PR_RULE_IDS",                                                        PR_RULE_IDS                                                          },
+	{ "PR_RULE_IDS_ERROR",                                                  PR_RULE_IDS_ERROR                                                    },
+	{ "PR_RULE_ID_ERROR",                                                   PR_RULE_ID_ERROR                                                     },
+	{ "PR_RULE_LEVEL",                                                      PR_RULE_LEVEL                                                        },
+	{ "PR_RULE_LEVEL_ERROR",                                                PR_RULE_LEVEL_ERROR                                                  },
+	{ "PR_RULE_MSG_LEVEL",                                                  PR_RULE_MSG_LEVEL                                                    },
+	{ "PR_RULE_MSG_LEVEL_ERROR",                                            PR_RULE_MSG_LEVEL_ERROR                                              },
+	{ "PR_RULE_MSG_NAME",                                                   PR_RULE_MSG_NAME                                                     },
+	{ "PR_RULE_MSG_PROVIDER",                                               PR_RULE_MSG_PROVIDER                                                 },
+	{ "PR_RULE_MSG_PROVIDER_DATA",                                          PR_RULE_MSG_PROVIDER_DATA                                            },
+	{ "PR_RULE_MSG_PROVIDER_DATA_ERROR",                                    PR_RULE_MSG_PROVIDER_DATA_ERROR                                      },
+	{ "PR_RULE_MSG_SEQUENCE",                                               PR_RULE_MSG_SEQUENCE                                                 },
+	{ "PR_RULE_MSG_SEQUENCE_ERROR",                                         PR_RULE_MSG_SEQUENCE_ERROR                                           },
+	{ "PR_RULE_MSG_STATE",                                                  PR_RULE_MSG_STATE                                                    },
+	{ "PR_RULE_MSG_STATE_ERROR",                                            PR_RULE_MSG_STATE_ERROR                                              },
+	{ "PR_RULE_MSG_USER_FLAGS",                                             PR_RULE_MSG_USER_FLAGS                                               },
+	{ "PR_RULE_MSG_USER_FLAGS_ERROR",                                       PR_RULE_MSG_USER_FLAGS_ERROR                                         },
+	{ "PR_RULE_NAME",                                                       PR_RULE_NAME                                                         },
+	{ "PR_RULE_NAME_ERROR",                                                 PR_RULE_NAME_ERROR                                                   },
+	{ "PR_RULE_NAME_UNICODE",                                               PR_RULE_NAME_UNICODE                                                 },
+	{ "PR_RULE_PROVIDER",                                                   PR_RULE_PROVIDER                                                     },
+	{ "PR_RULE_PROVIDER_DATA",                                              PR_RULE_PROVIDER_DATA                                                },
+	{ "PR_RULE_PROVIDER_DATA_ERROR",                                        PR_RULE_PROVIDER_DATA_ERROR                                          },
+	{ "PR_RULE_PROVIDER_ERROR",                                             PR_RULE_PROVIDER_ERROR                                               },
+	{ "PR_RULE_PROVIDER_UNICODE",                                           PR_RULE_PROVIDER_UNICODE                                             },
+	{ "PR_RULE_SEQUENCE",                                                   PR_RULE_SEQUENCE                                                     },
+	{ "PR_RULE_SEQUENCE_ERROR",                                             PR_RULE_SEQUENCE_ERROR                                               },
+	{ "PR_RULE_STATE",                                                      PR_RULE_STATE                                                        },
+	{ "PR_RULE_STATE_ERROR",                                                PR_RULE_STATE_ERROR                                                  },
+	{ "PR_RULE_USER_FLAGS",                                                 PR_RULE_USER_FLAGS                                                   },
+	{ "PR_RULE_USER_FLAGS_ERROR",                                           PR_RULE_USER_FLAGS_ERROR                                             },
+	{ "PR_RW_RULES_STREAM",                                                 PR_RW_RULES_STREAM                                                   },
+	{ "PR_RW_RULES_STREAM_ERROR",                                           PR_RW_RULES_STREAM_ERROR                                             },
+	{ "PR_SCHDINFO_APPT_TOMBSTONE",                                         PR_SCHDINFO_APPT_TOMBSTONE                                           },
+	{ "PR_SCHDINFO_APPT_TOMBSTONE_ERROR",                                   PR_SCHDINFO_APPT_TOMBSTONE_ERROR                                     },
+	{ "PR_SCHDINFO_AUTO_ACCEPT_APPTS",                                      PR_SCHDINFO_AUTO_ACCEPT_APPTS                                        },
+	{ "PR_SCHDINFO_AUTO_ACCEPT_APPTS_ERROR",                                PR_SCHDINFO_AUTO_ACCEPT_APPTS_ERROR                                  },
+	{ "PR_SCHDINFO_BOSS_WANTS_COPY",                                        PR_SCHDINFO_BOSS_WANTS_COPY                                          },
+	{ "PR_SCHDINFO_BOSS_WANTS_COPY_ERROR",                                  PR_SCHDINFO_BOSS_WANTS_COPY_ERROR                                    },
+	{ "PR_SCHDINFO_BOSS_WANTS_INFO",                                        PR_SCHDINFO_BOSS_WANTS_INFO                                          },
+	{ "PR_SCHDINFO_BOSS_WANTS_INFO_ERROR",                                  PR_SCHDINFO_BOSS_WANTS_INFO_ERROR                                    },
+	{ "PR_SCHDINFO_DELEGATE_ENTRYIDS",                                      PR_SCHDINFO_DELEGATE_ENTRYIDS                                        },
+	{ "PR_SCHDINFO_DELEGATE_ENTRYIDS_ERROR",                                PR_SCHDINFO_DELEGATE_ENTRYIDS_ERROR                                  },
+	{ "PR_SCHDINFO_DELEGATE_NAMES",                                         PR_SCHDINFO_DELEGATE_NAMES                                           },
+	{ "PR_SCHDINFO_DELEGATE_NAMES_ERROR",                                   PR_SCHDINFO_DELEGATE_NAMES_ERROR                                     },
+	{ "PR_SCHDINFO_DELEGATE_NAMES_UNICODE",                                 PR_SCHDINFO_DELEGATE_NAMES_UNICODE                                   },
+	{ "PR_SCHDINFO_DISALLOW_OVERLAPPING_APPTS",                             PR_SCHDINFO_DISALLOW_OVERLAPPING_APPTS                               },
+	{ "PR_SCHDINFO_DISALLOW_OVERLAPPING_APPTS_ERROR",                       PR_SCHDINFO_DISALLOW_OVERLAPPING_APPTS_ERROR                         },
+	{ "PR_SCHDINFO_DISALLOW_RECURRING_APPTS",                               PR_SCHDINFO_DISALLOW_RECURRING_APPTS                                 },
+	{ "PR_SCHDINFO_DISALLOW_RECURRING_APPTS_ERROR",                         PR_SCHDINFO_DISALLOW_RECURRING_APPTS_ERROR                           },
+	{ "PR_SCHDINFO_DONT_MAIL_DELEGATES",                                    PR_SCHDINFO_DONT_MAIL_DELEGATES                                      },
+	{ "PR_SCHDINFO_DONT_MAIL_DELEGATES_ERROR",                              PR_SCHDINFO_DONT_MAIL_DELEGATES_ERROR                                },
+	{ "PR_SCHDINFO_FREEBUSY",                                               PR_SCHDINFO_FREEBUSY                                                 },
+	{ "PR_SCHDINFO_FREEBUSY_BUSY",                                          PR_SCHDINFO_FREEBUSY_BUSY                                            },
+	{ "PR_SCHDINFO_FREEBUSY_BUSY_ERROR",                                    PR_SCHDINFO_FREEBUSY_BUSY_ERROR                                      },
+	{ "PR_SCHDINFO_FREEBUSY_ERROR",                                         PR_SCHDINFO_FREEBUSY_ERROR                                           },
+	{ "PR_SCHDINFO_FREEBUSY_MERGED",                                        PR_SCHDINFO_FREEBUSY_MERGED                                          },
+	{ "PR_SCHDINFO_FREEBUSY_MERGED_ERROR",                                  PR_SCHDINFO_FREEBUSY_MERGED_ERROR                                    },
+	{ "PR_SCHDINFO_FREEBUSY_OOF",                                           PR_SCHDINFO_FREEBUSY_OOF                                             },
+	{ "PR_SCHDINFO_FREEBUSY_OOF_ERROR",                                     PR_SCHDINFO_FREEBUSY_OOF_ERROR                                       },
+	{ "PR_SCHDINFO_FREEBUSY_TENTATIVE",                                     PR_SCHDINFO_FREEBUSY_TENTATIVE                                       },
+	{ "PR_SCHDINFO_FREEBUSY_TENTATIVE_ERROR",                               PR_SCHDINFO_FREEBUSY_TENTATIVE_ERROR                                 },
+	{ "PR_SCHDINFO_MONTHS_BUSY",                                            PR_SCHDINFO_MONTHS_BUSY                                              },
+	{ "PR_SCHDINFO_MONTHS_BUSY_ERROR",                                      PR_SCHDINFO_MONTHS_BUSY_ERROR                                        },
+	{ "PR_SCHDINFO_MONTHS_MERGED",                                          PR_SCHDINFO_MONTHS_MERGED                                            },
+	{ "PR_SCHDINFO_MONTHS_MERGED_ERROR",                                    PR_SCHDINFO_MONTHS_MERGED_ERROR                                      },
+	{ "PR_SCHDINFO_MONTHS_OOF",                                             PR_SCHDINFO_MONTHS_OOF                                               },
+	{ "PR_SCHDINFO_MONTHS_OOF_ERROR",                                       PR_SCHDINFO_MONTHS_OOF_ERROR                                         },
+	{ "PR_SCHDINFO_MONTHS_TENTATIVE",                                       PR_SCHDINFO_MONTHS_TENTATIVE                                         },
+	{ "PR_SCHDINFO_MONTHS_TENTATIVE_ERROR",                                 PR_SCHDINFO_MONTHS_TENTATIVE_ERROR                                   },
+	{ "PR_SCHDINFO_RESOURCE_TYPE",                                          PR_SCHDINFO_RESOURCE_TYPE                                            },
+	{ "PR_SCHDINFO_RESOURCE_TYPE_ERROR",                                    PR_SCHDINFO_RESOURCE_TYPE_ERROR                                      },
+	{ "PR_SEARCH_KEY",                                                      PR_SEARCH_KEY                                                        },
+	{ "PR_SEARCH_KEY_ERROR",                                                PR_SEARCH_KEY_ERROR                                                  },
+	{ "PR_SELECTABLE",                                                      PR_SELECTABLE                                                        },
+	{ "PR_SELECTABLE_ERROR",                                                PR_SELECTABLE_ERROR                                                  },
+	{ "PR_SENDER_ADDRTYPE",                                                 PR_SENDER_ADDRTYPE                                                   },
+	{ "PR_SENDER_ADDRTYPE_ERROR",                                           PR_SENDER_ADDRTYPE_ERROR                                             },
+	{ "PR_SENDER_ADDRTYPE_UNICODE",                                         PR_SENDER_ADDRTYPE_UNICODE                                           },
+	{ "PR_SENDER_EMAIL_ADDRESS",                                            PR_SENDER_EMAIL_ADDRESS                                              },
+	{ "PR_SENDER_EMAIL_ADDRESS_ERROR",                                      PR_SENDER_EMAIL_ADDRESS_ERROR                                        },
+	{ "PR_SENDER_EMAIL_ADDRESS_UNICODE",                                    PR_SENDER_EMAIL_ADDRESS_UNICODE                                      },
+	{ "PR_SENDER_ENTRYID",                                                  PR_SENDER_ENTRYID                                                    },
+	{ "PR_SENDER_ENTRYID_ERROR",                                            PR_SENDER_ENTRYID_ERROR                                              },
+	{ "PR_SENDER_ID_STATUS",                                                PR_SENDER_ID_STATUS                                                  },
+	{ "PR_SENDER_ID_STATUS_ERROR",                                          PR_SENDER_ID_STATUS_ERROR                                            },
+	{ "PR_SENDER_NAME",                                                     PR_SENDER_NAME                                                       },
+	{ "PR_SENDER_NAME_ERROR",                                               PR_SENDER_NAME_ERROR                                                 },
+	{ "PR_SENDER_NAME_UNICODE",                                             PR_SENDER_NAME_UNICODE                                               },
+	{ "PR_SENDER_SEARCH_KEY",                                               PR_SENDER_SEARCH_KEY                                                 },
+	{ "PR_SENDER_SEARCH_KEY_ERROR",                                         PR_SENDER_SEARCH_KEY_ERROR                                           },
+	{ "PR_SEND_INTERNET_ENCODING",                                          PR_SEND_INTERNET_ENCODING                                            },
+	{ "PR_SEND_INTERNET_ENCODING_ERROR",                                    PR_SEND_INTERNET_ENCODING_ERROR                                      },
+	{ "PR_SEND_RICH_INFO",                                                  PR_SEND_RICH_INFO                                                    },
+	{ "PR_SEND_RICH_INFO_ERROR",                                            PR_SEND_RICH_INFO_ERROR                                              },
+	{ "PR_SENSITIVITY",                                                     PR_SENSITIVITY                                                       },
+	{ "PR_SENSITIVITY_ERROR",                                               PR_SENSITIVITY_ERROR                                                 },
+	{ "PR_SENT_REPRESENTING_ADDRTYPE",                                      PR_SENT_REPRESENTING_ADDRTYPE                                        },
+	{ "PR_SENT_REPRESENTING_ADDRTYPE_ERROR",                                PR_SENT_REPRESENTING_ADDRTYPE_ERROR                                  },
+	{ "PR_SENT_REPRESENTING_ADDRTYPE_UNICODE",                              PR_SENT_REPRESENTING_ADDRTYPE_UNICODE                                },
+	{ "PR_SENT_REPRESENTING_EMAIL_ADDRESS",                                 PR_SENT_REPRESENTING_EMAIL_ADDRESS                                   },
+	{ "PR_SENT_REPRESENTING_EMAIL_ADDRESS_ERROR",                           PR_SENT_REPRESENTING_EMAIL_ADDRESS_ERROR                             },
+	{ "PR_SENT_REPRESENTING_EMAIL_ADDRESS_UNICODE",                         PR_SENT_REPRESENTING_EMAIL_ADDRESS_UNICODE                           },
+	{ "PR_SENT_REPRESENTING_ENTRYID",                                       PR_SENT_REPRESENTING_ENTRYID                                         },
+	{ "PR_SENT_REPRESENTING_ENTRYID_ERROR",                                 PR_SENT_REPRESENTING_ENTRYID_ERROR                                   },
+	{ "PR_SENT_REPRESENTING_NAME",                                          PR_SENT_REPRESENTING_NAME                                            },
+	{ "PR_SENT_REPRESENTING_NAME_ERROR",                                    PR_SENT_REPRESENTING_NAME_ERROR                                      },
+	{ "PR_SENT_REPRESENTING_NAME_UNICODE",                                  PR_SENT_REPRESENTING_NAME_UNICODE                                    },
+	{ "PR_SENT_REPRESENTING_SEARCH_KEY",                                    PR_SENT_REPRESENTING_SEARCH_KEY                                      },
+	{ "PR_SENT_REPRESENTING_SEARCH_KEY_ERROR",                              PR_SENT_REPRESENTING_SEARCH_KEY_ERROR                                },
+	{ "PR_SENT_REPRESENTING_SMTP_ADDRESS",                                  PR_SENT_REPRESENTING_SMTP_ADDRESS                                    },
+	{ "PR_SENT_REPRESENTING_SMTP_ADDRESS_ERROR",                            PR_SENT_REPRESENTING_SMTP_ADDRESS_ERROR                              },
+	{ "PR_SENT_REPRESENTING_SMTP_ADDRESS_UNICODE",                          PR_SENT_REPRESENTING_SMTP_ADDRESS_UNICODE                            },
+	{ "PR_SMTP_ADDRESS",                                                    PR_SMTP_ADDRESS                                                      },
+	{ "PR_SMTP_ADDRESS_ERROR",                                              PR_SMTP_ADDRESS_ERROR                                                },
+	{ "PR_SMTP_ADDRESS_UNICODE",                                            PR_SMTP_ADDRESS_UNICODE                                              },
+	{ "PR_SORT_LOCALE_ID",                                                  PR_SORT_LOCALE_ID                                                    },
+	{ "PR_SORT_LOCALE_ID_ERROR",                                            PR_SORT_LOCALE_ID_ERROR                                              },
+	{ "PR_SOURCE_KEY",                                                      PR_SOURCE_KEY                                                        },
+	{ "PR_SOURCE_KEY_ERROR",                                                PR_SOURCE_KEY_ERROR                                                  },
+	{ "PR_SPLUS_FREE_BUSY_ENTRYID",                                         PR_SPLUS_FREE_BUSY_ENTRYID                                           },
+	{ "PR_SPLUS_FREE_BUSY_ENTRYID_ERROR",                                   PR_SPLUS_FREE_BUSY_ENTRYID_ERROR                                     },
+	{ "PR_SPOUSE_NAME",                                                     PR_SPOUSE_NAME                                                       },
+	{ "PR_SPOUSE_NAME_ERROR",                                               PR_SPOUSE_NAME_ERROR                                                 },
+	{ "PR_SPOUSE_NAME_UNICODE",                                             PR_SPOUSE_NAME_UNICODE                                               },
+	{ "PR_START_DATE",                                                      PR_START_DATE                                                        },
+	{ "PR_START_DATE_ERROR",                                                PR_START_DATE_ERROR                                                  },
+	{ "PR_START_DATE_ETC",                                                  PR_START_DATE_ETC                                                    },
+	{ "PR_START_DATE_ETC_ERROR",                                            PR_START_DATE_ETC_ERROR                                              },
+	{ "PR_STATE_OR_PROVINCE",                                               PR_STATE_OR_PROVINCE                                                 },
+	{ "PR_STATE_OR_PROVINCE_ERROR",                                         PR_STATE_OR_PROVINCE_ERROR                                           },
+	{ "PR_STATE_OR_PROVINCE_UNICODE",                                       PR_STATE_OR_PROVINCE_UNICODE                                         },
+	{ "PR_STORE_ENTRYID",                                                   PR_STORE_ENTRYID                                                     },
+	{ "PR_STORE_ENTRYID_ERROR",                                             PR_STORE_ENTRYID_ERROR                                               },
+	{ "PR_STORE_STATE",                                                     PR_STORE_STATE                                                       },
+	{ "PR_STORE_STATE_ERROR",                                               PR_STORE_STATE_ERROR                                                 },
+	{ "PR_STORE_SUPPORT_MASK",                                              PR_STORE_SUPPORT_MASK                                                },
+	{ "PR_STORE_SUPPORT_MASK_ERROR",                                        PR_STORE_SUPPORT_MASK_ERROR                                          },
+	{ "PR_STREET_ADDRESS",                                                  PR_STREET_ADDRESS                                                    },
+	{ "PR_STREET_ADDRESS_ERROR",                                            PR_STREET_ADDRESS_ERROR                                              },
+	{ "PR_STREET_ADDRESS_UNICODE",                                          PR_STREET_ADDRESS_UNICODE                                            },
+	{ "PR_SUBFOLDERS",                                                      PR_SUBFOLDERS                                                        },
+	{ "PR_SUBFOLDERS_ERROR",                                                PR_SUBFOLDERS_ERROR                                                  },
+	{ "PR_SUBJECT",                                                         PR_SUBJECT                                                           },
+	{ "PR_SUBJECT_ERROR",                                                   PR_SUBJECT_ERROR                                                     },
+	{ "PR_SUBJECT_PREFIX",                                                  PR_SUBJECT_PREFIX                                                    },
+	{ "PR_SUBJECT_PREFIX_ERROR",                                            PR_SUBJECT_PREFIX_ERROR                                              },
+	{ "PR_SUBJECT_PREFIX_UNICODE",                                          PR_SUBJECT_PREFIX_UNICODE                                            },
+	{ "PR_SUBJECT_UNICODE",                                                 PR_SUBJECT_UNICODE                                                   },
+	{ "PR_SUPPLEMENTARY_INFO",                                              PR_SUPPLEMENTARY_INFO                                                },
+	{ "PR_SUPPLEMENTARY_INFO_ERROR",                                        PR_SUPPLEMENTARY_INFO_ERROR                                          },
+	{ "PR_SUPPLEMENTARY_INFO_UNICODE",                                      PR_SUPPLEMENTARY_INFO_UNICODE                                        },
+	{ "PR_SURNAME",                                                         PR_SURNAME                                                           },
+	{ "PR_SURNAME_ERROR",                                                   PR_SURNAME_ERROR                                                     },
+	{ "PR_SURNAME_UNICODE",                                                 PR_SURNAME_UNICODE                                                   },
+	{ "PR_SWAPPED_TODO_DATA",                                               PR_SWAPPED_TODO_DATA                                                 },
+	{ "PR_SWAPPED_TODO_DATA_ERROR",                                         PR_SWAPPED_TODO_DATA_ERROR                                           },
+	{ "PR_SWAPPED_TODO_STORE",                                              PR_SWAPPED_TODO_STORE                                                },
+	{ "PR_SWAPPED_TODO_STORE_ERROR",                                        PR_SWAPPED_TODO_STORE_ERROR                                          },
+	{ "PR_TARGET_ENTRYID",                                                  PR_TARGET_ENTRYID                                                    },
+	{ "PR_TARGET_ENTRYID_ERROR",                                            PR_TARGET_ENTRYID_ERROR                                              },
+	{ "PR_TELEX_NUMBER",                                                    PR_TELEX_NUMBER                                                      },
+	{ "PR_TELEX_NUMBER_ERROR",                                              PR_TELEX_NUMBER_ERROR                                                },
+	{ "PR_TELEX_NUMBER_UNICODE",                                            PR_TELEX_NUMBER_UNICODE                                              },
+	{ "PR_TEMPLATEID",                                                      PR_TEMPLATEID                                                        },
+	{ "PR_TEMPLATEID_ERROR",                                                PR_TEMPLATEID_ERROR                                                  },
+	{ "PR_TITLE",                                                           PR_TITLE                                                             },
+	{ "PR_TITLE_ERROR",                                                     PR_TITLE_ERROR                                                       },
+	{ "PR_TITLE_UNICODE",                                                   PR_TITLE_UNICODE                                                     },
+	{ "PR_TNEF_CORRELATION_KEY",                                            PR_TNEF_CORRELATION_KEY                                              },
+	{ "PR_TNEF_CORRELATION_KEY_ERROR",                                      PR_TNEF_CORRELATION_KEY_ERROR                                        },
+	{ "PR_TODO_ITEM_FLAGS",                                                 PR_TODO_ITEM_FLAGS                                                   },
+	{ "PR_TODO_ITEM_FLAGS_ERROR",                                           PR_TODO_ITEM_FLAGS_ERROR                                             },
+	{ "PR_TRANSMITABLE_DISPLAY_NAME",                                       PR_TRANSMITABLE_DISPLAY_NAME                                         },
+	{ "PR_TRANSMITABLE_DISPLAY_NAME_ERROR",                                 PR_TRANSMITABLE_DISPLAY_NAME_ERROR                                   },
+	{ "PR_TRANSMITABLE_DISPLAY_NAME_UNICODE",                               PR_TRANSMITABLE_DISPLAY_NAME_UNICODE                                 },
+	{ "PR_TRANSMITTABLE_DISPLAY_NAME",                                      PR_TRANSMITTABLE_DISPLAY_NAME                                        },
+	{ "PR_TRANSMITTABLE_DISPLAY_NAME_UNICODE",                              PR_TRANSMITTABLE_DISPLAY_NAME_UNICODE                                },
+	{ "PR_TRANSPORT_MESSAGE_HEADERS",                                       PR_TRANSPORT_MESSAGE_HEADERS                                         },
+	{ "PR_TRANSPORT_MESSAGE_HEADERS_ERROR",                                 PR_TRANSPORT_MESSAGE_HEADERS_ERROR                                   },
+	{ "PR_TRANSPORT_MESSAGE_HEADERS_UNICODE",                               PR_TRANSPORT_MESSAGE_HEADERS_UNICODE                                 },
+	{ "PR_TRUST_SENDER",                                                    PR_TRUST_SENDER                                                      },
+	{ "PR_TRUST_SENDER_ERROR",                                              PR_TRUST_SENDER_ERROR                                                },
+	{ "PR_TTYTDD_PHONE_NUMBER",                                             PR_TTYTDD_PHONE_NUMBER                                               },
+	{ "PR_TTYTDD_PHONE_NUMBER_ERROR",                                       PR_TTYTDD_PHONE_NUMBER_ERROR                                         },
+	{ "PR_TTYTDD_PHONE_NUMBER_UNICODE",                                     PR_TTYTDD_PHONE_NUMBER_UNICODE                                       },
+	{ "PR_URL_COMP_NAME_SET",                                               PR_URL_COMP_NAME_SET                                                 },
+	{ "PR_USER_CERTIFICATE",                                                PR_USER_CERTIFICATE                                                  },
+	{ "PR_USER_CERTIFICATE_ERROR",                                          PR_USER_CERTIFICATE_ERROR                                            },
+	{ "PR_USER_ENTRYID",                                                    PR_USER_ENTRYID                                                      },
+	{ "PR_USER_ENTRYID_ERROR",                                              PR_USER_ENTRYID_ERROR                                                },
+	{ "PR_USER_X509_CERTIFICATE",                                           PR_USER_X509_CERTIFICATE                                             },
+	{ "PR_USER_X509_CERTIFICATE_ERROR",                                     PR_USER_X509_CERTIFICATE_ERROR                                       },
+	{ "PR_VD_BINARY",                                                       PR_VD_BINARY                                                         },
+	{ "PR_VD_BINARY_ERROR",                                                 PR_VD_BINARY_ERROR                                                   },
+	{ "PR_VD_NAME",                                                         PR_VD_NAME                                                           },
+	{ "PR_VD_NAME_ERROR",                                                   PR_VD_NAME_ERROR                                                     },
+	{ "PR_VD_NAME_UNICODE",                                                 PR_VD_NAME_UNICODE                                                   },
+	{ "PR_VD_STRINGS",                                                      PR_VD_STRINGS                                                        },
+	{ "PR_VD_STRINGS_ERROR",                                                PR_VD_STRINGS_ERROR                                                  },
+	{ "PR_VD_STRINGS_UNICODE",                                              PR_VD_STRINGS_UNICODE                                                },
+	{ "PR_VD_VERSION",                                                      PR_VD_VERSION                                                        },
+	{ "PR_VD_VERSION_ERROR",                                                PR_VD_VERSION_ERROR                                                  },
+	{ "PR_WB_SF_DEFINITION",                                                PR_WB_SF_DEFINITION                                                  },
+	{ "PR_WB_SF_DEFINITION_ERROR",                                          PR_WB_SF_DEFINITION_ERROR                                            },
+	{ "PR_WB_SF_EFP_FLAGS",                                                 PR_WB_SF_EFP_FLAGS                                                   },
+	{ "PR_WB_SF_EFP_FLAGS_ERROR",                                           PR_WB_SF_EFP_FLAGS_ERROR                                             },
+	{ "PR_WB_SF_EXPIRATION",                                                PR_WB_SF_EXPIRATION                                                  },
+	{ "PR_WB_SF_EXPIRATION_ERROR",                                          PR_WB_SF_EXPIRATION_ERROR                                            },
+	{ "PR_WB_SF_LAST_USED",                                                 PR_WB_SF_LAST_USED                                                   },
+	{ "PR_WB_SF_LAST_USED_ERROR",                                           PR_WB_SF_LAST_USED_ERROR                                             },
+	{ "PR_WB_SF_RECREATE_INFO",                                             PR_WB_SF_RECREATE_INFO                                               },
+	{ "PR_WB_SF_RECREATE_INFO_ERROR",                                       PR_WB_SF_RECREATE_INFO_ERROR                                         },
+	{ "PR_WB_SF_STORAGE_TYPE",                                              PR_WB_SF_STORAGE_TYPE                                                },
+	{ "PR_WB_SF_STORAGE_TYPE_ERROR",                                        PR_WB_SF_STORAGE_TYPE_ERROR                                          },
+	{ "PR_WB_SF_TEMPLATE_ID",                                               PR_WB_SF_TEMPLATE_ID                                                 },
+	{ "PR_WB_SF_TEMPLATE_ID_ERROR",                                         PR_WB_SF_TEMPLATE_ID_ERROR                                           },
+	{ "PR_WEDDING_ANNIVERSARY",                                             PR_WEDDING_ANNIVERSARY                                               },
+	{ "PR_WEDDING_ANNIVERSARY_ERROR",                                       PR_WEDDING_ANNIVERSARY_ERROR                                         },
+	{ "PR_WLINK_ABEID",                                                     PR_WLINK_ABEID                                                       },
+	{ "PR_WLINK_ABEID_ERROR",                                               PR_WLINK_ABEID_ERROR                                                 },
+	{ "PR_WLINK_AB_EXSTOREEID",                                             PR_WLINK_AB_EXSTOREEID                                               },
+	{ "PR_WLINK_AB_EXSTOREEID_ERROR",                                       PR_WLINK_AB_EXSTOREEID_ERROR                                         },
+	{ "PR_WLINK_CALENDAR_COLOR",                                            PR_WLINK_CALENDAR_COLOR                                              },
+	{ "PR_WLINK_CALENDAR_COLOR_ERROR",                                      PR_WLINK_CALENDAR_COLOR_ERROR                                        },
+	{ "PR_WLINK_CLIENTID",                                                  PR_WLINK_CLIENTID                                                    },
+	{ "PR_WLINK_CLIENTID_ERROR",                                            PR_WLINK_CLIENTID_ERROR                                              },
+	{ "PR_WLINK_ENTRYID",                                                   PR_WLINK_ENTRYID                                                     },
+	{ "PR_WLINK_ENTRYID_ERROR",                                             PR_WLINK_ENTRYID_ERROR                                               },
+	{ "PR_WLINK_FLAGS",                                                     PR_WLINK_FLAGS                                                       },
+	{ "PR_WLINK_FLAGS_ERROR",                                               PR_WLINK_FLAGS_ERROR                                                 },
+	{ "PR_WLINK_FOLDER_TYPE",                                               PR_WLINK_FOLDER_TYPE                                                 },
+	{ "PR_WLINK_FOLDER_TYPE_ERROR",                                         PR_WLINK_FOLDER_TYPE_ERROR                                           },
+	{ "PR_WLINK_GROUP_CLSID",                                               PR_WLINK_GROUP_CLSID                                                 },
+	{ "PR_WLINK_GROUP_CLSID_ERROR",                                         PR_WLINK_GROUP_CLSID_ERROR                                           },
+	{ "PR_WLINK_GROUP_NAME",                                                PR_WLINK_GROUP_NAME                                                  },
+	{ "PR_WLINK_GROUP_NAME_ERROR",                                          PR_WLINK_GROUP_NAME_ERROR                                            },
+	{ "PR_WLINK_GROUP_NAME_UNICODE",                                        PR_WLINK_GROUP_NAME_UNICODE                                          },
+	{ "PR_WLINK_ORDINAL",                                                   PR_WLINK_ORDINAL                                                     },
+	{ "PR_WLINK_ORDINAL_ERROR",                                             PR_WLINK_ORDINAL_ERROR                                               },
+	{ "PR_WLINK_RECKEY",                                                    PR_WLINK_RECKEY                                                      },
+	{ "PR_WLINK_RECKEY_ERROR",                                              PR_WLINK_RECKEY_ERROR                                                },
+	{ "PR_WLINK_RO_GROUP_TYPE",                                             PR_WLINK_RO_GROUP_TYPE                                               },
+	{ "PR_WLINK_RO_GROUP_TYPE_ERROR",                                       PR_WLINK_RO_GROUP_TYPE_ERROR                                         },
+	{ "PR_WLINK_SECTION",                                                   PR_WLINK_SECTION                                                     },
+	{ "PR_WLINK_SECTION_ERROR",                                             PR_WLINK_SECTION_ERROR                                               },
+	{ "PR_WLINK_STORE_ENTRYID",                                             PR_WLINK_STORE_ENTRYID                                               },
+	{ "PR_WLINK_STORE_ENTRYID_ERROR",                                       PR_WLINK_STORE_ENTRYID_ERROR                                         },
+	{ "PR_WLINK_TYPE",                                                      PR_WLINK_TYPE                                                        },
+	{ "PR_WLINK_TYPE_ERROR",                                                PR_WLINK_TYPE_ERROR                                                  },
+	{ "PidTagAttributeSystem",                                              PidTagAttributeSystem                                                },
+	{ "PidTagDesignInProgress",                                             PidTagDesignInProgress                                               },
+	{ "PidTagExtendedACLData",                                              PidTagExtendedACLData                                                },
+	{ "PidTagFolderChildCount",                                             PidTagFolderChildCount                                               },
+	{ "PidTagNormalMessageSize",                                            PidTagNormalMessageSize                                              },
+	{ "PidTagOriginalDisplayName",                                          PidTagOriginalDisplayName                                            },
+	{ "PidTagSecureOrigination",                                            PidTagSecureOrigination                                              },
+	{ "PidTagUrlCompName",                                                  PidTagUrlCompName                                                    },
+	{ "PidTagUrlCompNameSet",                                               PidTagUrlCompNameSet                                                 },
+};
+
+#define CANONICAL_PROPERTY_TAGS_COUNT (sizeof (canonical_property_tags_by_tag) / sizeof (canonical_property_tags_by_tag[0]))
+#define PROPERTY_ALTNAMES_COUNT (sizeof (property_altnames_table) / sizeof (property_altnames_table[0]))
+
+/**
+   \details Return the position in canonical_property_tags_by_tag of
+   the first canonical entry whose tag is greater or equal to proptag
+ */
+static uint32_t get_proptag_lower_bound(uint32_t proptag)
 {
-	uint32_t idx;
+	uint32_t	low = 0;
+	uint32_t	high = CANONICAL_PROPERTY_TAGS_COUNT;
+	uint32_t	mid;
 
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if (canonical_property_tags[idx].proptag == proptag) { 
-			return canonical_property_tags[idx].propname;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (canonical_property_tags[canonical_property_tags_by_tag[mid]].proptag < proptag) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
 	}
+
+	return low;
+}
+
+static const char *get_canonical_proptag_name(uint32_t proptag)
+{
+	uint32_t	pos;
+
+	pos = get_proptag_lower_bound(proptag);
+	if (pos < CANONICAL_PROPERTY_TAGS_COUNT &&
+	    canonical_property_tags[canonical_property_tags_by_tag[pos]].proptag == proptag) {
+		return canonical_property_tags[canonical_property_tags_by_tag[pos]].propname;
+	}
+
+	return NULL;
+}
+
+_PUBLIC_ const char *get_proptag_name(uint32_t proptag)
+{
+	const char	*propname;
+
+	propname = get_canonical_proptag_name(proptag);
+	if (propname) {
+		return propname;
+	}
 	if (((proptag & 0xFFFF) == PT_STRING8) ||
 	    ((proptag & 0xFFFF) == PT_MV_STRING8)) {
 		proptag += 1; /* try as _UNICODE variant */
-	}
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if (canonical_property_tags[idx].proptag == proptag) { 
-			return canonical_property_tags[idx].propname;
-		}
+		return get_canonical_proptag_name(proptag);
 	}
 	return NULL;
 }
 
+static int property_altnames_cmp(const void *key, const void *member)
+{
+	return strcmp((const char *)key, ((const struct mapi_propaltnames *)member)->propname);
+}
+
 _PUBLIC_ uint32_t get_proptag_value(const char *propname)
 {
-	uint32_t idx;
+	const struct mapi_propaltnames	*altname;
+	uint32_t			low = 0;
+	uint32_t			high = CANONICAL_PROPERTY_TAGS_COUNT;
+	uint32_t			mid;
+	int				cmp;
 
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if (!strcmp(canonical_property_tags[idx].propname, propname)) { 
-			return canonical_property_tags[idx].proptag;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cmp = strcmp(canonical_property_tags[canonical_property_tags_by_name[mid]].propname, propname);
+		if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
 	}
+	if (low < CANONICAL_PROPERTY_TAGS_COUNT &&
+	    !strcmp(canonical_property_tags[canonical_property_tags_by_name[low]].propname, propname)) {
+		return canonical_property_tags[canonical_property_tags_by_name[low]].proptag;
+	}
+
+	/* Fallback on alternative names (PR_*) */
+	altname = bsearch(propname, property_altnames_table, PROPERTY_ALTNAMES_COUNT,
+			  sizeof (struct mapi_propaltnames), property_altnames_cmp);
+	if (altname) {
+		return altname->proptag;
+	}
 
 	return 0;
 }
 
 _PUBLIC_ uint16_t get_property_type(uint16_t untypedtag)
 {
+	uint32_t	pos;
 	uint32_t	idx;
+	uint32_t	found = CANONICAL_PROPERTY_TAGS_COUNT;
 	uint16_t	current_type;
 
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if ((canonical_property_tags[idx].proptag >> 16) == untypedtag) {
-			current_type = canonical_property_tags[idx].proptype;
-			if (current_type != PT_ERROR && current_type != PT_STRING8) {
-				return current_type;
-			}
+	/* Entries sharing the same property ID are adjacent, keep
+	 * the first match in canonical table order */
+	for (pos = get_proptag_lower_bound((uint32_t)untypedtag << 16);
+	     pos < CANONICAL_PROPERTY_TAGS_COUNT; pos++) {
+		idx = canonical_property_tags_by_tag[pos];
+		if ((canonical_property_tags[idx].proptag >> 16) != untypedtag) {
+			break;
 		}
+		current_type = canonical_property_tags[idx].proptype;
+		if (current_type != PT_ERROR && current_type != PT_STRING8 && idx < found) {
+			found = idx;
+		}
+	}
+	if (found < CANONICAL_PROPERTY_TAGS_COUNT) {
+		return canonical_property_tags[found].proptype;
 	}
 
 	OC_DEBUG(5, "type for property '%x' could not be deduced", untypedtag);
@@ -605,6 +605,95 @@ _PUBLIC_ enum MAPISTATUS GetFolderItemsCount(mapi_object_t *obj_folder,
 }
 
 
+/**
+   \details Retrieves the whole folder tree below a folder in a single
+   hierarchy table pass.
+
+   The hierarchy table is opened with TableFlags_Depth, so it holds the
+   folders from all levels. Each row starts with PR_FID, PR_PARENT_FID
+   and PR_DEPTH, followed by the optional columns.
+
+   \param obj_folder the folder to get the tree of
+   \param SPropTagArray the additional columns to fetch, may be NULL
+   \param SRowSet pointer to the row set to return the folders in
+
+   Developers are required to call MAPIFreeBuffer(SRowSet.aRow) when
+   they do not need the folders anymore.
+
+   \return MAPI_E_SUCCESS on success, otherwise a failure code (MAPISTATUS)
+   indicating the error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_NOT_INITIALIZED: MAPI subsystem has not been initialized.
+   - MAPI_E_INVALID_PARAMETER: obj_folder or SRowSet is undefined
+   - MAPI_E_NOT_ENOUGH_MEMORY: the row set could not be allocated
+
+   \sa GetHierarchyTable, QueryRows, GetLastError
+*/
+_PUBLIC_ enum MAPISTATUS GetFolderTree(mapi_object_t *obj_folder,
+				       struct SPropTagArray *SPropTagArray,
+				       struct SRowSet *SRowSet)
+{
+	enum MAPISTATUS		retval;
+	TALLOC_CTX		*mem_ctx;
+	mapi_object_t		obj_htable;
+	struct SPropTagArray	*columns;
+	struct SRowSet		rows;
+	uint32_t		count = 0;
+	uint32_t		i;
+
+	OPENCHANGE_RETVAL_IF(!obj_folder, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!SRowSet, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_named(mapi_object_get_session(obj_folder), 0, "GetFolderTree");
+
+	mapi_object_init(&obj_htable);
+	retval = GetHierarchyTable(obj_folder, &obj_htable, TableFlags_Depth, &count);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	columns = set_SPropTagArray(mem_ctx, 0x3, PR_FID, PR_PARENT_FID, PR_DEPTH);
+	for (i = 0; SPropTagArray && i < SPropTagArray->cValues; i++) {
+		SPropTagArray_add(mem_ctx, columns, SPropTagArray->aulPropTag[i]);
+	}
+
+	retval = SetColumns(&obj_htable, columns);
+	if (retval) goto end;
+
+	SRowSet->cRows = 0;
+	SRowSet->aRow = talloc_array((TALLOC_CTX *)mapi_object_get_session(obj_folder), struct SRow, count + 1);
+	if (!SRowSet->aRow) {
+		retval = MAPI_E_NOT_ENOUGH_MEMORY;
+		goto end;
+	}
+
+	/* The server may return fewer rows than asked per call */
+	while (SRowSet->cRows < count) {
+		retval = QueryRows(&obj_htable, count - SRowSet->cRows, TBL_ADVANCE, TBL_FORWARD_READ, &rows);
+		if (retval || !rows.cRows) break;
+
+		talloc_steal(SRowSet->aRow, rows.aRow);
+		for (i = 0; i < rows.cRows && SRowSet->cRows < count; i++) {
+			SRowSet->aRow[SRowSet->cRows++] = rows.aRow[i];
+		}
+	}
+
+	if (retval) {
+		MAPIFreeBuffer(SRowSet->aRow);
+		SRowSet->aRow = NULL;
+		SRowSet->cRows = 0;
+	}
+
+end:
+	mapi_object_release(&obj_htable);
+	talloc_free(mem_ctx);
+
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Adds permissions for a user on a given folder
 
@@ -0,0 +1,324 @@
+/*
+   OpenChange MAPI implementation.
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+
+/**
+   \file utf16.c
+
+   \brief Conversion of property strings between UTF-16LE and UTF-8
+
+   PT_UNICODE values travel as UTF-16LE and are handled as UTF-8. Most
+   of them are ASCII, which these functions convert eight bytes at a
+   time, without going through iconv. Characters outside ASCII are
+   decoded and encoded directly too. Only invalid input, such as an
+   unpaired surrogate, is left to the iconv based functions, so the
+   result is the same as before for any input.
+
+   mapi_utf8_to_utf16 and mapi_utf16_to_utf8 only validate and measure
+   the input when given no output buffer.
+ */
+
+
+#define	MAPI_UTF16_WORD		sizeof (uint64_t)
+
+/* Built from bytes, so the masks don't depend on the host byte order */
+static const uint8_t utf16_ascii_mask[MAPI_UTF16_WORD] = { 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF };
+static const uint8_t utf16_nonzero_add[MAPI_UTF16_WORD] = { 0x7F, 0x00, 0x7F, 0x00, 0x7F, 0x00, 0x7F, 0x00 };
+static const uint8_t utf16_nonzero_mask[MAPI_UTF16_WORD] = { 0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00 };
+static const uint8_t utf8_ascii_mask[MAPI_UTF16_WORD] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 };
+
+static uint64_t load_word(const uint8_t *p)
+{
+	uint64_t	w;
+
+	memcpy(&w, p, sizeof (w));
+	return w;
+}
+
+
+/**
+   \details Convert a UTF-16LE string to UTF-8
+
+   The conversion stops at the first NUL character or at the end of
+   the input, whichever comes first. No NUL terminator is written.
+
+   \param src the UTF-16LE string
+   \param src_len the length of src in bytes
+   \param dst the output buffer, at least (src_len / 2) * 3 bytes
+   long, or NULL to only validate and measure the input
+
+   \return the length of the UTF-8 string in bytes, or -1 if the input
+   is not valid UTF-16
+ */
+_PUBLIC_ ssize_t mapi_utf16_to_utf8(const uint8_t *src, size_t src_len, char *dst)
+{
+	uint64_t	ascii_mask = load_word(utf16_ascii_mask);
+	uint64_t	nonzero_add = load_word(utf16_nonzero_add);
+	uint64_t	nonzero_mask = load_word(utf16_nonzero_mask);
+	uint64_t	w;
+	size_t		i = 0;
+	size_t		out = 0;
+	uint32_t	c;
+	uint32_t	c2;
+
+	src_len &= ~(size_t)1;
+	while (i < src_len) {
+		/* Four ASCII characters, none of them NUL */
+		if (i + MAPI_UTF16_WORD <= src_len) {
+			w = load_word(src + i);
+			if (!(w & ascii_mask) && ((w + nonzero_add) & nonzero_mask) == nonzero_mask) {
+				if (dst) {
+					dst[out] = src[i];
+					dst[out + 1] = src[i + 2];
+					dst[out + 2] = src[i + 4];
+					dst[out + 3] = src[i + 6];
+				}
+				out += 4;
+				i += MAPI_UTF16_WORD;
+				continue;
+			}
+		}
+
+		c = src[i] | (src[i + 1] << 8);
+		i += 2;
+		if (c == 0) break;
+
+		if (c < 0x80) {
+			if (dst) dst[out] = c;
+			out += 1;
+		} else if (c < 0x800) {
+			if (dst) {
+				dst[out] = 0xC0 | (c >> 6);
+				dst[out + 1] = 0x80 | (c & 0x3F);
+			}
+			out += 2;
+		} else if (c < 0xD800 || c > 0xDFFF) {
+			if (dst) {
+				dst[out] = 0xE0 | (c >> 12);
+				dst[out + 1] = 0x80 | ((c >> 6) & 0x3F);
+				dst[out + 2] = 0x80 | (c & 0x3F);
+			}
+			out += 3;
+		} else {
+			/* A high surrogate followed by a low one */
+			if (c > 0xDBFF || i + 2 > src_len) return -1;
+			c2 = src[i] | (src[i + 1] << 8);
+			if (c2 < 0xDC00 || c2 > 0xDFFF) return -1;
+			i += 2;
+			c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+			if (dst) {
+				dst[out] = 0xF0 | (c >> 18);
+				dst[out + 1] = 0x80 | ((c >> 12) & 0x3F);
+				dst[out + 2] = 0x80 | ((c >> 6) & 0x3F);
+				dst[out + 3] = 0x80 | (c & 0x3F);
+			}
+			out += 4;
+		}
+	}
+
+	return out;
+}
+
+
+/**
+   \details Convert a UTF-8 string to UTF-16LE
+
+   No NUL terminator is written.
+
+   \param src the UTF-8 string
+   \param src_len the length of src in bytes, without its NUL
+   terminator
+   \param dst the output buffer, at least src_len * 2 bytes long, or
+   NULL to only validate and measure the input
+
+   \return the length of the UTF-16LE string in bytes, or -1 if the
+   input is not valid UTF-8
+ */
+_PUBLIC_ ssize_t mapi_utf8_to_utf16(const char *src, size_t src_len, uint8_t *dst)
+{
+	const uint8_t	*s = (const uint8_t *) src;
+	uint64_t	ascii_mask = load_word(utf8_ascii_mask);
+	size_t		i = 0;
+	size_t		out = 0;
+	size_t		n;
+	size_t		k;
+	uint32_t	c;
+
+	while (i < src_len) {
+		/* Eight ASCII characters */
+		if (i + MAPI_UTF16_WORD <= src_len && !(load_word(s + i) & ascii_mask)) {
+			if (dst) {
+				for (k = 0; k < MAPI_UTF16_WORD; k++) {
+					dst[out + 2 * k] = s[i + k];
+					dst[out + 2 * k + 1] = 0;
+				}
+			}
+			out += 2 * MAPI_UTF16_WORD;
+			i += MAPI_UTF16_WORD;
+			continue;
+		}
+
+		c = s[i];
+		if (c < 0x80) {
+			n = 0;
+		} else if (c >= 0xC2 && c <= 0xDF) {
+			n = 1;
+			c &= 0x1F;
+		} else if (c >= 0xE0 && c <= 0xEF) {
+			n = 2;
+			c &= 0x0F;
+		} else if (c >= 0xF0 && c <= 0xF4) {
+			n = 3;
+			c &= 0x07;
+		} else {
+			return -1;
+		}
+		if (i + n >= src_len && n) return -1;
+		for (k = 1; k <= n; k++) {
+			if ((s[i + k] & 0xC0) != 0x80) return -1;
+			c = (c << 6) | (s[i + k] & 0x3F);
+		}
+		/* Overlong forms, surrogates and values beyond Unicode */
+		if ((n == 2 && c < 0x800) || (n == 3 && (c < 0x10000 || c > 0x10FFFF)) ||
+		    (c >= 0xD800 && c <= 0xDFFF)) {
+			return -1;
+		}
+		i += n + 1;
+
+		if (c < 0x10000) {
+			if (dst) {
+				dst[out] = c & 0xFF;
+				dst[out + 1] = c >> 8;
+			}
+			out += 2;
+		} else {
+			c -= 0x10000;
+			if (dst) {
+				dst[out] = (0xD800 | (c >> 10)) & 0xFF;
+				dst[out + 1] = (0xD800 | (c >> 10)) >> 8;
+				dst[out + 2] = (0xDC00 | (c & 0x3FF)) & 0xFF;
+				dst[out + 3] = (0xDC00 | (c & 0x3FF)) >> 8;
+			}
+			out += 4;
+		}
+	}
+
+	return out;
+}
+
+
+/**
+   \details Convert a UTF-16LE string to a NUL terminated UTF-8 string
+
+   \param mem_ctx pointer to the memory context
+   \param src the UTF-16LE string, NUL terminated or not
+   \param src_len the length of src in bytes
+
+   \return the UTF-8 string on success, otherwise NULL
+ */
+_PUBLIC_ char *mapi_utf16_pull_talloc(TALLOC_CTX *mem_ctx, const uint8_t *src, size_t src_len)
+{
+	char		*dst;
+	smb_ucs2_t	*ucs2;
+	ssize_t		len;
+	size_t		converted;
+
+	dst = talloc_array(mem_ctx, char, (src_len / 2) * 3 + 1);
+	if (!dst) return NULL;
+
+	len = mapi_utf16_to_utf8(src, src_len, dst);
+	if (len >= 0) {
+		dst[len] = '\0';
+		return talloc_realloc(mem_ctx, dst, char, len + 1);
+	}
+	talloc_free(dst);
+
+	/* pull_ucs2_talloc needs a NUL terminated and aligned copy */
+	ucs2 = talloc_zero_array(mem_ctx, smb_ucs2_t, (src_len / 2) + 1);
+	if (!ucs2) return NULL;
+	memcpy(ucs2, src, src_len & ~(size_t)1);
+	if (!pull_ucs2_talloc(mem_ctx, &dst, ucs2, &converted)) {
+		dst = NULL;
+	}
+	talloc_free(ucs2);
+
+	return dst;
+}
+
+
+/**
+   \details Convert a UTF-8 string to a NUL terminated UTF-16LE string
+
+   \param mem_ctx pointer to the memory context
+   \param src the NUL terminated UTF-8 string
+   \param dst_len pointer to the returned length in bytes, including
+   the NUL terminator
+
+   \return the UTF-16LE string on success, otherwise NULL
+ */
+_PUBLIC_ uint8_t *mapi_utf16_push_talloc(TALLOC_CTX *mem_ctx, const char *src, size_t *dst_len)
+{
+	uint8_t		*dst;
+	size_t		src_len;
+	ssize_t		len;
+	size_t		converted;
+
+	src_len = strlen(src);
+	dst = talloc_array(mem_ctx, uint8_t, src_len * 2 + 2);
+	if (!dst) return NULL;
+
+	len = mapi_utf8_to_utf16(src, src_len, dst);
+	if (len < 0) {
+		talloc_free(dst);
+		if (!convert_string_talloc(mem_ctx, CH_UTF8, CH_UTF16LE, src, src_len + 1, (void **) &dst, &converted)) {
+			return NULL;
+		}
+		*dst_len = converted;
+		return dst;
+	}
+	dst[len] = 0;
+	dst[len + 1] = 0;
+	*dst_len = len + 2;
+
+	return dst;
+}
+
+
+/**
+   \details Return the size of a UTF-8 string once converted to
+   UTF-16LE, including its NUL terminator
+
+   \param src the NUL terminated UTF-8 string
+
+   \return the size in bytes
+ */
+_PUBLIC_ size_t mapi_utf16_size(const char *src)
+{
+	ssize_t	len;
+
+	len = mapi_utf8_to_utf16(src, strlen(src), NULL);
+	if (len < 0) {
+		return strlen_m_ext(src, CH_UTF8, CH_UTF16LE) * 2 + 2;
+	}
+
+	return len + 2;
+}
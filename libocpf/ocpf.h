@@ -38,6 +38,9 @@ enum ocpf_recipClass {
 	OCPF_MAPI_BCC
 };
 
+struct ocpf_context;
+struct ocpf_template;
+
 extern struct ocpf	*ocpf;
 
 #undef _PRINTF_ATTRIBUTE
@@ -71,6 +74,23 @@ struct SPropValue *ocpf_get_SPropValue(uint32_t, uint32_t *);
 enum MAPISTATUS ocpf_OpenFolder(uint32_t, mapi_object_t *, mapi_object_t *);
 enum MAPISTATUS ocpf_set_Recipients(TALLOC_CTX *, uint32_t, mapi_object_t *);
 enum MAPISTATUS ocpf_clear_props (uint32_t context_id);
+struct ocpf_context *ocpf_new_context_r(TALLOC_CTX *, const char *, uint8_t);
+int ocpf_del_context_r(struct ocpf_context *);
+int ocpf_parse_r(struct ocpf_context *);
+enum MAPISTATUS ocpf_get_recipients_r(TALLOC_CTX *, struct ocpf_context *, struct SRowSet **);
+enum MAPISTATUS ocpf_set_SPropValue_r(TALLOC_CTX *, struct ocpf_context *, mapi_object_t *, mapi_object_t *);
+struct SPropValue *ocpf_get_SPropValue_r(struct ocpf_context *, uint32_t *);
+enum MAPISTATUS ocpf_OpenFolder_r(struct ocpf_context *, mapi_object_t *, mapi_object_t *);
+uint64_t ocpf_get_folder_r(struct ocpf_context *);
+enum MAPISTATUS ocpf_set_Recipients_r(TALLOC_CTX *, struct ocpf_context *, mapi_object_t *);
+enum MAPISTATUS ocpf_clear_props_r(struct ocpf_context *);
+
+/* The following public definitions come from libocpf/ocpf_template.c */
+enum MAPISTATUS ocpf_template_compile_r(struct ocpf_context *, mapi_object_t *, struct ocpf_template **);
+struct SPropValue *ocpf_template_instantiate(TALLOC_CTX *, struct ocpf_template *, uint32_t *);
+enum MAPISTATUS ocpf_template_get_variable_type(struct ocpf_template *, const char *, uint16_t *);
+enum MAPISTATUS ocpf_template_set_variable(struct ocpf_template *, struct SPropValue *, const char *, const void *);
+enum MAPISTATUS ocpf_template_set_Recipients(struct ocpf_template *, mapi_object_t *);
 
 /* The following public definitions come from libocpf/ocpf_server.c */
 enum MAPISTATUS ocpf_server_set_type(uint32_t, const char *);
@@ -45,6 +45,7 @@ struct ocpf_property
 	struct ocpf_property	*next;
 	uint32_t		aulPropTag;
 	const void		*value;
+	const char		*var;		/* variable the value comes from */
 };
 
 struct ocpf_nprop
@@ -74,6 +75,7 @@ struct ocpf_nproperty
 	uint16_t		propType;
 	const char		*oleguid;
 	const void		*value;
+	const char		*var;		/* variable the value comes from */
 };
 
 struct ocpf_olfolder
@@ -93,6 +95,7 @@ struct ocpf_context
 	struct Binary_r		bin;
 	struct ocpf_nprop	nprop;
 	unsigned int		lineno;
+	unsigned int		errors;
 	int			result;
 	/* ocpf */
 	const char		*type;
@@ -114,6 +117,22 @@ struct ocpf_context
 	struct ocpf_context	*next;
 };
 
+struct ocpf_template_slot
+{
+	const char		*name;		/* variable name */
+	uint32_t		index;		/* in the template lpProps */
+};
+
+struct ocpf_template
+{
+	struct ocpf_context		*ctx;
+	struct SPropValue		*lpProps;
+	uint32_t			cValues;
+	struct ocpf_template_slot	*slots;
+	uint32_t			slot_count;
+	struct SRowSet			*recipients;	/* resolved, NULL if none */
+};
+
 struct ocpf_freeid
 {
 	uint32_t		context_id;
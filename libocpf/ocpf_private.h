@@ -71,6 +71,13 @@ int ocpf_binary_add(struct ocpf_context *, const char *, struct Binary_r *);
 /* The following private definitions come from libocpf/ocpf_write.c */
 char *ocpf_write_unescape_string(TALLOC_CTX *, const char *);
 
+/* The following private definitions come from libocpf/ocpf_public.c */
+enum MAPISTATUS ocpf_build_SPropValue(TALLOC_CTX *, struct ocpf_context *, mapi_object_t *, mapi_object_t *, struct ocpf_template *);
+enum MAPISTATUS ocpf_resolve_Recipients(TALLOC_CTX *, struct ocpf_context *, struct mapi_session *, struct SRowSet **);
+
+/* The following private definitions come from libocpf/ocpf_template.c */
+void ocpf_template_add_slot(struct ocpf_template *, const char *, uint32_t);
+
 /* The following private definitions come from libocpf/ocpf_context.c */
 struct ocpf_context *ocpf_context_init(TALLOC_CTX *, const char *, uint8_t, uint32_t);
 struct ocpf_context *ocpf_context_add(struct ocpf *, const char *, uint32_t *, uint8_t, bool *);
@@ -29,14 +29,15 @@
 #include "libocpf/ocpf_api.h"
 #include "libocpf/ocpf_private.h"
 
-int ocpf_yylex_init(void *);
 int ocpf_yylex_init_extra(struct ocpf_context *, void *);
 void ocpf_yyset_in(FILE *, void *);
 int ocpf_yylex_destroy(void *);
 int ocpf_yyparse(struct ocpf_context *, void *);
 
+/* Identifier of the contexts which are not in the global context */
+#define	OCPF_CONTEXT_ID_DETACHED	0xFFFFFFFF
+
 struct ocpf	*ocpf;
-int		error_flag;
 
 
 /**
@@ -143,6 +144,67 @@ _PUBLIC_ int ocpf_del_context(uint32_t context_id)
 }
 
 
+static int ocpf_context_destructor(struct ocpf_context *ctx)
+{
+	if (ctx->fp) {
+		fclose(ctx->fp);
+		ctx->fp = NULL;
+	}
+
+	return 0;
+}
+
+
+/**
+   \details Create a new OCPF context outside the global context
+
+   The context does not need ocpf_init and does not share any state
+   with other contexts: contexts can be used concurrently from
+   several threads, provided each one is used by a single thread at a
+   time and that the threads do not share memory contexts. The
+   context is used with the _r functions of this API.
+
+   \param mem_ctx the memory context to allocate the context from
+   \param filename the filename to process
+   \param flags Flags controlling how the OCPF should be opened
+
+   \return the new context on success, otherwise NULL
+
+   \sa ocpf_del_context_r, ocpf_parse_r
+ */
+_PUBLIC_ struct ocpf_context *ocpf_new_context_r(TALLOC_CTX *mem_ctx, const char *filename, uint8_t flags)
+{
+	struct ocpf_context	*ctx;
+
+	ctx = ocpf_context_init(mem_ctx, filename, flags, OCPF_CONTEXT_ID_DETACHED);
+	if (!ctx) return NULL;
+
+	talloc_set_destructor(ctx, ocpf_context_destructor);
+
+	return ctx;
+}
+
+
+/**
+   \details Delete an OCPF context created with ocpf_new_context_r
+
+   Freeing the memory context the context was allocated from has the
+   same effect.
+
+   \param ctx the context to delete
+
+   \return OCPF_SUCCESS on success, otherwise OCPF_ERROR
+ */
+_PUBLIC_ int ocpf_del_context_r(struct ocpf_context *ctx)
+{
+	OCPF_RETVAL_IF(!ctx || ctx->context_id != OCPF_CONTEXT_ID_DETACHED, NULL, OCPF_INVALID_CONTEXT, NULL);
+
+	talloc_free(ctx);
+
+	return OCPF_SUCCESS;
+}
+
+
 /**
    \details Parse OCPF file
 
@@ -157,9 +219,7 @@ _PUBLIC_ int ocpf_del_context(uint32_t context_id)
  */
 _PUBLIC_ int ocpf_parse(uint32_t context_id)
 {
-	int			ret;
 	struct ocpf_context	*ctx;
-	void			*scanner;
 
 	/* Sanity checks */
 	OCPF_RETVAL_IF(!ocpf || !ocpf->mem_ctx, NULL, OCPF_NOT_INITIALIZED, NULL);
@@ -168,13 +228,37 @@ _PUBLIC_ int ocpf_parse(uint32_t context_id)
 	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
 	OCPF_RETVAL_IF(!ctx, NULL, OCPF_INVALID_CONTEXT, NULL);
 
-	ret = ocpf_yylex_init(&scanner);
+	return ocpf_parse_r(ctx);
+}
+
+
+/**
+   \details Parse OCPF file
+
+   Reentrant version of ocpf_parse: the scanner and the parser only
+   use the state of ctx.
+
+   \param ctx the context holding the file to be parsed
+
+   \return OCPF_SUCCESS on success, otherwise OCPF_ERROR
+
+   \sa ocpf_new_context_r
+ */
+_PUBLIC_ int ocpf_parse_r(struct ocpf_context *ctx)
+{
+	int			ret;
+	void			*scanner;
+
+	/* Sanity checks */
+	OCPF_RETVAL_IF(!ctx || !ctx->fp, NULL, OCPF_INVALID_CONTEXT, NULL);
+
 	ret = ocpf_yylex_init_extra(ctx, &scanner);
+	OCPF_RETVAL_IF(ret, ctx, OCPF_FATAL_ERROR, NULL);
 	ocpf_yyset_in(ctx->fp, scanner);
 	ret = ocpf_yyparse(ctx, scanner);
 	ocpf_yylex_destroy(scanner);
 
-	return ret;
+	return ret ? OCPF_ERROR : OCPF_SUCCESS;
 }
 
 
@@ -254,22 +338,78 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_SPropValue(TALLOC_CTX *mem_ctx,
 					     uint32_t context_id,
 					     mapi_object_t *obj_folder,
 					     mapi_object_t *obj_message)
+{
+	struct ocpf_context	*ctx;
+
+	/* sanity checks */
+	MAPI_RETVAL_IF(!ocpf, MAPI_E_NOT_INITIALIZED, NULL);
+	
+	/* Step 0. Search for the context */
+	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
+	OCPF_RETVAL_IF(!ctx, NULL, OCPF_INVALID_CONTEXT, NULL);
+
+	return ocpf_set_SPropValue_r(mem_ctx, ctx, obj_folder, obj_message);
+}
+
+
+/**
+   \details Build a SPropValue array from ocpf context
+
+   Reentrant version of ocpf_set_SPropValue. obj_message may be NULL
+   when the message is not created yet, binary values too large to be
+   set with SetProps are then left in the array instead of being
+   streamed to the message.
+
+   \param mem_ctx the memory context to use for memory allocation
+   \param ctx the context to build a SPropValue array for
+   \param obj_folder pointer the folder object we use for internal
+   MAPI operations
+   \param obj_message pointer to the message object we use for
+   internal MAPI operations, may be NULL
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \sa ocpf_get_SPropValue_r
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_set_SPropValue_r(TALLOC_CTX *mem_ctx,
+					       struct ocpf_context *ctx,
+					       mapi_object_t *obj_folder,
+					       mapi_object_t *obj_message)
+{
+	return ocpf_build_SPropValue(mem_ctx, ctx, obj_folder, obj_message, NULL);
+}
+
+
+/**
+   \details Build the SPropValue array of a context
+
+   \param mem_ctx the memory context to use for memory allocation
+   \param ctx the context to build a SPropValue array for
+   \param obj_folder pointer the folder object we use for internal
+   MAPI operations
+   \param obj_message pointer to the message object we use for
+   internal MAPI operations, may be NULL
+   \param tmpl the template to record the values set from variables
+   in, may be NULL
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+enum MAPISTATUS ocpf_build_SPropValue(TALLOC_CTX *mem_ctx,
+				      struct ocpf_context *ctx,
+				      mapi_object_t *obj_folder,
+				      mapi_object_t *obj_message,
+				      struct ocpf_template *tmpl)
 {
 	enum MAPISTATUS		retval;
 	struct mapi_nameid	*nameid;
 	struct SPropTagArray	*SPropTagArray;
 	struct ocpf_property	*pel;
 	struct ocpf_nproperty	*nel;
-	struct ocpf_context	*ctx;
 	uint32_t		i;
 
 	/* sanity checks */
-	MAPI_RETVAL_IF(!ocpf, MAPI_E_NOT_INITIALIZED, NULL);
+	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
 	MAPI_RETVAL_IF(!obj_folder, MAPI_E_INVALID_PARAMETER, NULL);
-	
-	/* Step 0. Search for the context */
-	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
-	OCPF_RETVAL_IF(!ctx, NULL, OCPF_INVALID_CONTEXT, NULL);
 
 	if (!mem_ctx) {
 		mem_ctx = (TALLOC_CTX *) ctx;
@@ -306,7 +446,7 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_SPropValue(TALLOC_CTX *mem_ctx,
 		/* Step4. Add named properties */
 		for (nel = ctx->nprops, i = 0; SPropTagArray->aulPropTag[i] && nel->next; nel = nel->next, i++) {
 			if (SPropTagArray->aulPropTag[i]) {
-				if (((SPropTagArray->aulPropTag[i] & 0xFFFF) == PT_BINARY) &&
+				if (((SPropTagArray->aulPropTag[i] & 0xFFFF) == PT_BINARY) && obj_message &&
 				    (((struct Binary_r *)nel->value)->cb > MAX_READ_SIZE)) {
 					retval = ocpf_stream(mem_ctx, obj_message, SPropTagArray->aulPropTag[i],
 							     (struct Binary_r *)nel->value);
@@ -324,6 +464,9 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_SPropValue(TALLOC_CTX *mem_ctx,
 				} else {
 					ctx->lpProps = add_SPropValue(mem_ctx, ctx->lpProps, &ctx->cValues,
 								       SPropTagArray->aulPropTag[i], nel->value);
+					if (tmpl && nel->var) {
+						ocpf_template_add_slot(tmpl, nel->var, ctx->cValues - 1);
+					}
 				}
 			}
 		}
@@ -333,7 +476,7 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_SPropValue(TALLOC_CTX *mem_ctx,
 	/* Step5. Add Known properties */
 	if (ctx->props && ctx->props->next) {
 		for (pel = ctx->props; pel->next; pel = pel->next) {
-			if (((pel->aulPropTag & 0xFFFF) == PT_BINARY) && 
+			if (((pel->aulPropTag & 0xFFFF) == PT_BINARY) && obj_message &&
 			    (((struct Binary_r *)pel->value)->cb > MAX_READ_SIZE)) {
 				retval = ocpf_stream(mem_ctx, obj_message, pel->aulPropTag, 
 						     (struct Binary_r *)pel->value);
@@ -344,6 +487,9 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_SPropValue(TALLOC_CTX *mem_ctx,
 				}
 				ctx->lpProps = add_SPropValue(mem_ctx, ctx->lpProps, &ctx->cValues, 
 							       pel->aulPropTag, pel->value);
+				if (tmpl && pel->var) {
+					ocpf_template_add_slot(tmpl, pel->var, ctx->cValues - 1);
+				}
 			}
 		}
 	}
@@ -374,6 +520,22 @@ enum MAPISTATUS ocpf_clear_props (uint32_t context_id)
 	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
 	MAPI_RETVAL_IF(!ctx, MAPI_E_NOT_FOUND, NULL);
 
+	return ocpf_clear_props_r(ctx);
+}
+
+/**
+  \details Clear the known properties from the OCPF entity
+
+  Reentrant version of ocpf_clear_props.
+
+  \param ctx the context to clear properties from
+
+  \return MAPI_E_SUCCESS on success, otherwise a non-zero error code
+*/
+_PUBLIC_ enum MAPISTATUS ocpf_clear_props_r(struct ocpf_context *ctx)
+{
+	MAPI_RETVAL_IF(!ctx, MAPI_E_NOT_FOUND, NULL);
+
 	if (ctx->props) {
 		talloc_free(ctx->props);
 	}
@@ -407,6 +569,25 @@ _PUBLIC_ struct SPropValue *ocpf_get_SPropValue(uint32_t context_id, uint32_t *c
 	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
 	OCPF_RETVAL_TYPE(!ctx, NULL, OCPF_INVALID_CONTEXT, NULL, NULL);
 
+	return ocpf_get_SPropValue_r(ctx, cValues);
+}
+
+
+/**
+   \details Get the OCPF SPropValue array
+
+   Reentrant version of ocpf_get_SPropValue.
+
+   \param ctx the context to retrieve SPropValue from
+   \param cValues pointer on the number of SPropValue entries
+
+   \return NULL on error, otherwise returns an allocated lpProps pointer
+
+   \sa ocpf_set_SPropValue_r
+ */
+_PUBLIC_ struct SPropValue *ocpf_get_SPropValue_r(struct ocpf_context *ctx, uint32_t *cValues)
+{
+	OCPF_RETVAL_TYPE(!ctx, NULL, OCPF_INVALID_CONTEXT, NULL, NULL);
 	OCPF_RETVAL_TYPE(!ctx->lpProps || !ctx->cValues, ctx, OCPF_INVALID_PROPARRAY, NULL, NULL);
 
 	*cValues = ctx->cValues;
@@ -494,18 +675,43 @@ _PUBLIC_ enum MAPISTATUS ocpf_OpenFolder(uint32_t context_id,
 					 mapi_object_t *obj_store,
 					 mapi_object_t *obj_folder)
 {
-	enum MAPISTATUS		retval;
 	struct ocpf_context	*ctx;
-	mapi_id_t		id_folder;
-	mapi_id_t		id_tis;
 
 	/* Sanity checks */
 	MAPI_RETVAL_IF(!ocpf, MAPI_E_NOT_INITIALIZED, NULL);
-	MAPI_RETVAL_IF(!obj_store, MAPI_E_INVALID_PARAMETER, NULL);
 
 	/* Step 1. Search for the context */
 	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
 	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return ocpf_OpenFolder_r(ctx, obj_store, obj_folder);
+}
+
+
+/**
+   \details Open OCPF folder
+
+   Reentrant version of ocpf_OpenFolder.
+
+   \param ctx the context to open the folder for
+   \param obj_store the store object
+   \param obj_folder the folder to open
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_FOUND.
+
+   \sa ocpf_new_context_r, ocpf_parse_r
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_OpenFolder_r(struct ocpf_context *ctx,
+					   mapi_object_t *obj_store,
+					   mapi_object_t *obj_folder)
+{
+	enum MAPISTATUS		retval;
+	mapi_id_t		id_folder;
+	mapi_id_t		id_tis;
+
+	/* Sanity checks */
+	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!obj_store, MAPI_E_INVALID_PARAMETER, NULL);
 	MAPI_RETVAL_IF(!ctx->folder, MAPI_E_NOT_FOUND, NULL);
 
 	mapi_object_init(obj_folder);
@@ -584,6 +790,22 @@ static bool set_external_recipients(TALLOC_CTX *mem_ctx, struct SRowSet *SRowSet
 }
 
 
+/**
+   \details Return the folder an OCPF context is imported to
+
+   \param ctx the context to return the folder of
+
+   \return the folder declared by the file, either a default folder
+   identifier (olFolder) or a folder ID, 0 if the file declares none
+
+   \sa ocpf_OpenFolder_r
+ */
+_PUBLIC_ uint64_t ocpf_get_folder_r(struct ocpf_context *ctx)
+{
+	return ctx ? ctx->folder : 0;
+}
+
+
 /**
    \details Set the message recipients from ocpf context
 
@@ -603,8 +825,71 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_Recipients(TALLOC_CTX *mem_ctx,
 					     uint32_t context_id,
 					     mapi_object_t *obj_message)
 {
-	enum MAPISTATUS			retval;
 	struct ocpf_context		*ctx;
+
+	MAPI_RETVAL_IF(!ocpf, MAPI_E_NOT_INITIALIZED, NULL);
+
+	/* Step 1. Search for the context */
+	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
+	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return ocpf_set_Recipients_r(mem_ctx, ctx, obj_message);
+}
+
+
+/**
+   \details Set the message recipients from ocpf context
+
+   Reentrant version of ocpf_set_Recipients.
+
+   \param mem_ctx the memory context to use for memory allocation
+   \param ctx the context to set recipients for
+   \param obj_message pointer to the message object we use for
+   internal MAPI operations
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \sa ocpf_get_recipients_r
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_set_Recipients_r(TALLOC_CTX *mem_ctx,
+					       struct ocpf_context *ctx,
+					       mapi_object_t *obj_message)
+{
+	enum MAPISTATUS			retval;
+	struct SRowSet			*SRowSet;
+
+	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!obj_message, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!ctx->recipients->cRows, MAPI_E_NOT_FOUND, NULL);
+
+	retval = ocpf_resolve_Recipients(mem_ctx, ctx, mapi_object_get_session(obj_message), &SRowSet);
+	MAPI_RETVAL_IF(retval, retval, NULL);
+
+	/* Step4. Call ModifyRecipients */
+	retval = ModifyRecipients(obj_message, SRowSet);
+	MAPI_RETVAL_IF(retval, retval, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Resolve the recipients of a context
+
+   \param mem_ctx the memory context to use for memory allocation
+   \param ctx the context to resolve recipients for
+   \param session the session to resolve names with
+   \param SRowSetp pointer on pointer to the ModifyRecipients row set
+   to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+ */
+enum MAPISTATUS ocpf_resolve_Recipients(TALLOC_CTX *mem_ctx,
+					struct ocpf_context *ctx,
+					struct mapi_session *session,
+					struct SRowSet **SRowSetp)
+{
+	enum MAPISTATUS			retval;
 	struct SPropTagArray		*SPropTagArray;
 	struct SPropValue		SPropValue;
 	struct SPropValue		*lpProps;
@@ -617,15 +902,6 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_Recipients(TALLOC_CTX *mem_ctx,
 	uint32_t			i;
 	const void			*propdata;
 
-	MAPI_RETVAL_IF(!ocpf, MAPI_E_NOT_INITIALIZED, NULL);
-	MAPI_RETVAL_IF(!obj_message, MAPI_E_INVALID_PARAMETER, NULL);
-
-	/* Step 1. Search for the context */
-	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
-	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
-
-	MAPI_RETVAL_IF(!ctx->recipients->cRows, MAPI_E_NOT_FOUND, NULL);
-
 	SPropTagArray = set_SPropTagArray(mem_ctx, 0x8,
 					  PidTagObjectType,
 					  PidTagDisplayName,
@@ -650,7 +926,7 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_Recipients(TALLOC_CTX *mem_ctx,
 	}
 	usernames[i] = NULL;
 
-	retval = ResolveNames(mapi_object_get_session(obj_message), (const char **)usernames,
+	retval = ResolveNames(session, (const char **)usernames,
 			      SPropTagArray, &RowSet, &flaglist, 0);
 	MAPIFreeBuffer(SPropTagArray);
 	MAPI_RETVAL_IF(retval, retval, usernames);
@@ -677,9 +953,7 @@ _PUBLIC_ enum MAPISTATUS ocpf_set_Recipients(TALLOC_CTX *mem_ctx,
 	SPropValue.value.l = 0;
 	SRowSet_propcpy(mem_ctx, SRowSet, SPropValue);
 
-	/* Step4. Call ModifyRecipients */
-	retval = ModifyRecipients(obj_message, SRowSet);
-	MAPI_RETVAL_IF(retval, retval, NULL);
+	*SRowSetp = SRowSet;
 
 	return MAPI_E_SUCCESS;
 }
@@ -707,11 +981,36 @@ _PUBLIC_ enum MAPISTATUS ocpf_get_recipients(TALLOC_CTX *mem_ctx,
 
 	/* Sanity checks */
 	MAPI_RETVAL_IF(!ocpf, MAPI_E_NOT_INITIALIZED, NULL);
-	MAPI_RETVAL_IF(!SRowSet, MAPI_E_INVALID_PARAMETER, NULL);
 
 	/* Step 1. Search for the context */
 	ctx = ocpf_context_search_by_context_id(ocpf->context, context_id);
 	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return ocpf_get_recipients_r(mem_ctx, ctx, SRowSet);
+}
+
+
+/**
+   \details Get the message recipients from ocpf context
+
+   Reentrant version of ocpf_get_recipients.
+
+   \param mem_ctx the memory context to use for memory allocation
+   \param ctx the context to get recipients from
+   \param SRowSet pointer on pointer to the set of recipients to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if the file
+   has no recipient, otherwise MAPI error
+
+   \sa ocpf_set_Recipients_r
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_get_recipients_r(TALLOC_CTX *mem_ctx,
+					       struct ocpf_context *ctx,
+					       struct SRowSet **SRowSet)
+{
+	/* Sanity checks */
+	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!SRowSet, MAPI_E_INVALID_PARAMETER, NULL);
 	MAPI_RETVAL_IF(!ctx->recipients->cRows, MAPI_E_NOT_FOUND, NULL);
 
 	*SRowSet = ctx->recipients;
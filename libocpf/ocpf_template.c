@@ -0,0 +1,250 @@
+/*
+   OpenChange OCPF (OpenChange Property File) implementation.
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libocpf/ocpf.h"
+#include "libocpf/ocpf_api.h"
+#include "libocpf/ocpf_private.h"
+
+/**
+   \file ocpf_template.c
+
+   \brief ocpf Template API
+
+   A template is a parsed OCPF file compiled once against a folder:
+   named properties are resolved to property tags, recipients are
+   resolved and the SPropValue array is built. Each instance is a
+   copy of that array in which the properties set from OCPF variables
+   can be substituted, and costs neither parsing nor any round-trip
+   besides the ones creating the message.
+ */
+
+
+/**
+   \details Record a property set from a variable
+
+   \param tmpl the template being compiled
+   \param name the variable name
+   \param index the index of the property in the template array
+ */
+void ocpf_template_add_slot(struct ocpf_template *tmpl, const char *name, uint32_t index)
+{
+	tmpl->slots = talloc_realloc(tmpl, tmpl->slots, struct ocpf_template_slot, tmpl->slot_count + 1);
+	tmpl->slots[tmpl->slot_count].name = name;
+	tmpl->slots[tmpl->slot_count].index = index;
+	tmpl->slot_count++;
+}
+
+
+/**
+   \details Compile a parsed OCPF context into a template
+
+   The template is allocated from the context and freed with it. Large
+   binary values are not streamed and are set like any other property
+   when the template is instantiated.
+
+   \param ctx the parsed context to compile
+   \param obj_folder the folder the messages will be created in, used
+   to resolve named properties and recipients
+   \param tmplp pointer on pointer to the template to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error.
+
+   \note Developers may also call GetLastError() to retrieve the last
+   MAPI error code. Possible MAPI error codes are:
+   - MAPI_E_INVALID_PARAMETER: one of the parameters is missing
+   - MAPI_E_NOT_ENOUGH_MEMORY: the template could not be allocated
+
+   \sa ocpf_parse_r, ocpf_template_instantiate
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_template_compile_r(struct ocpf_context *ctx,
+						 mapi_object_t *obj_folder,
+						 struct ocpf_template **tmplp)
+{
+	enum MAPISTATUS		retval;
+	struct ocpf_template	*tmpl;
+	struct mapi_nameid	*nameid;
+	struct SPropTagArray	*SPropTagArray;
+
+	/* Sanity checks */
+	MAPI_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!obj_folder, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!tmplp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	tmpl = talloc_zero(ctx, struct ocpf_template);
+	MAPI_RETVAL_IF(!tmpl, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	tmpl->ctx = ctx;
+
+	/* Step 1. Build the properties and record the variable slots */
+	retval = ocpf_build_SPropValue(tmpl, ctx, obj_folder, NULL, tmpl);
+	MAPI_RETVAL_IF(retval, retval, tmpl);
+
+	tmpl->lpProps = ctx->lpProps;
+	tmpl->cValues = ctx->cValues;
+	ctx->lpProps = NULL;
+	ctx->cValues = 0;
+
+	/* Step 2. Map the canonical named properties SetProps would map */
+	nameid = mapi_nameid_new(tmpl);
+	if (mapi_nameid_lookup_SPropValue(nameid, tmpl->lpProps, tmpl->cValues) == MAPI_E_SUCCESS) {
+		SPropTagArray = talloc_zero(nameid, struct SPropTagArray);
+		retval = GetIDsFromNames(obj_folder, nameid->count, nameid->nameid, 0, &SPropTagArray);
+		MAPI_RETVAL_IF(retval, retval, tmpl);
+		mapi_nameid_map_SPropValue(nameid, tmpl->lpProps, tmpl->cValues, SPropTagArray);
+	}
+	MAPIFreeBuffer(nameid);
+
+	/* Step 3. Resolve the recipients */
+	if (ctx->recipients->cRows) {
+		retval = ocpf_resolve_Recipients(tmpl, ctx, mapi_object_get_session(obj_folder),
+						 &tmpl->recipients);
+		MAPI_RETVAL_IF(retval, retval, tmpl);
+	}
+
+	*tmplp = tmpl;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Create an instance of a template
+
+   The instance is a copy of the template SPropValue array. Its values
+   still point to the template memory, unless substituted with
+   ocpf_template_set_variable. The array is ready to be set with
+   SetProps and the MAPI_PROPS_SKIP_NAMEDID_CHECK flag.
+
+   \param mem_ctx the memory context to allocate the instance from
+   \param tmpl the template to instantiate
+   \param cValues pointer to the number of properties to return
+
+   \return the instance on success, otherwise NULL
+
+   \sa ocpf_template_set_variable, ocpf_template_set_Recipients
+ */
+_PUBLIC_ struct SPropValue *ocpf_template_instantiate(TALLOC_CTX *mem_ctx,
+						      struct ocpf_template *tmpl,
+						      uint32_t *cValues)
+{
+	struct SPropValue	*lpProps;
+
+	/* Sanity checks */
+	if (!tmpl || !cValues) return NULL;
+
+	lpProps = talloc_array(mem_ctx, struct SPropValue, tmpl->cValues + 1);
+	if (!lpProps) return NULL;
+
+	memcpy(lpProps, tmpl->lpProps, tmpl->cValues * sizeof (struct SPropValue));
+	*cValues = tmpl->cValues;
+
+	return lpProps;
+}
+
+
+/**
+   \details Return the property type of a template variable
+
+   \param tmpl the template to search
+   \param name the variable name, without the leading $
+   \param propType pointer to the property type to return: strings are
+   always PT_UNICODE
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if no property
+   is set from this variable, otherwise MAPI error.
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_template_get_variable_type(struct ocpf_template *tmpl,
+							 const char *name,
+							 uint16_t *propType)
+{
+	uint32_t	i;
+
+	/* Sanity checks */
+	MAPI_RETVAL_IF(!tmpl || !name || !propType, MAPI_E_INVALID_PARAMETER, NULL);
+
+	for (i = 0; i < tmpl->slot_count; i++) {
+		if (!strcmp(tmpl->slots[i].name, name)) {
+			*propType = tmpl->lpProps[tmpl->slots[i].index].ulPropTag & 0xFFFF;
+			return MAPI_E_SUCCESS;
+		}
+	}
+
+	MAPI_RETVAL_IF(true, MAPI_E_NOT_FOUND, NULL);
+}
+
+
+/**
+   \details Substitute a variable in a template instance
+
+   Every property the file sets from the variable is given the new
+   value, which must remain valid as long as the instance is used.
+
+   \param tmpl the template the instance was created from
+   \param lpProps the instance returned by ocpf_template_instantiate
+   \param name the variable name, without the leading $
+   \param value pointer to the value, of the type returned by
+   ocpf_template_get_variable_type
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if no property
+   is set from this variable, otherwise MAPI error.
+
+   \sa ocpf_template_instantiate
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_template_set_variable(struct ocpf_template *tmpl,
+						    struct SPropValue *lpProps,
+						    const char *name,
+						    const void *value)
+{
+	bool		found = false;
+	uint32_t	i;
+
+	/* Sanity checks */
+	MAPI_RETVAL_IF(!tmpl || !lpProps || !name || !value, MAPI_E_INVALID_PARAMETER, NULL);
+
+	for (i = 0; i < tmpl->slot_count; i++) {
+		if (!strcmp(tmpl->slots[i].name, name)) {
+			set_SPropValue(&lpProps[tmpl->slots[i].index], value);
+			found = true;
+		}
+	}
+	MAPI_RETVAL_IF(!found, MAPI_E_NOT_FOUND, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Set the recipients resolved when the template was compiled
+
+   \param tmpl the template to set recipients from
+   \param obj_message the message to set recipients for
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if the file has
+   no recipient, otherwise MAPI error.
+
+   \sa ocpf_set_Recipients_r
+ */
+_PUBLIC_ enum MAPISTATUS ocpf_template_set_Recipients(struct ocpf_template *tmpl,
+						      mapi_object_t *obj_message)
+{
+	/* Sanity checks */
+	MAPI_RETVAL_IF(!tmpl || !obj_message, MAPI_E_INVALID_PARAMETER, NULL);
+	MAPI_RETVAL_IF(!tmpl->recipients, MAPI_E_NOT_FOUND, NULL);
+
+	return ModifyRecipients(obj_message, tmpl->recipients);
+}
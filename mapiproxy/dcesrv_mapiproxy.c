@@ -23,6 +23,7 @@
 
 #include "mapiproxy/dcesrv_mapiproxy.h"
 #include "mapiproxy/dcesrv_mapiproxy_proto.h"
+#include "mapiproxy/util/trace.h"
 #include "utils/dlinklist.h"
 #include "libmapi/libmapi.h"
 #include "libmapi/libmapi_private.h"
@@ -223,6 +224,8 @@ static NTSTATUS mapiproxy_op_bind_proxy(struct dcesrv_call_state *dce_call, cons
 static NTSTATUS mapiproxy_op_bind(struct dcesrv_call_state *dce_call, const struct dcesrv_interface *iface, uint32_t if_version)
 {
 	struct dcesrv_mapiproxy_private		*private;
+	const struct ndr_interface_table	*table;
+	const struct mapiproxy_module		*server;
 	bool					server_mode;
 	bool					ndrdump;
 	char					*server_id_printable = NULL;
@@ -253,6 +256,7 @@ static NTSTATUS mapiproxy_op_bind(struct dcesrv_call_state *dce_call, const stru
 	private->server_mode = server_mode;
 	private->connected = false;
 	private->ndrdump = ndrdump;
+	private->server_dispatch = NULL;
 
 	dce_call->context->private_data = private;
 	dce_call->state_flags |= DCESRV_CALL_STATE_FLAG_MULTIPLEXED;
@@ -261,6 +265,18 @@ static NTSTATUS mapiproxy_op_bind(struct dcesrv_call_state *dce_call, const stru
 	  return mapiproxy_op_bind_proxy(dce_call, iface, if_version);
 	}
 
+	/* Without any module hooking the interface, calls are bound
+	   to the server dispatch function once and for all */
+	table = (const struct ndr_interface_table *)iface->private_data;
+	if (!ndrdump && table && !mapiproxy_module_loaded(table->name) &&
+	    lpcfg_parm_bool(dce_call->conn->dce_ctx->lp_ctx, NULL, "dcerpc_mapiproxy", "fast_path", true)) {
+		server = mapiproxy_server_byendpoint(table->name);
+		if (server) {
+			private->server_dispatch = server->dispatch;
+			OC_DEBUG(5, "mapiproxy::mapiproxy_op_bind: %s calls dispatched to %s", table->name, server->name);
+		}
+	}
+
 	return NT_STATUS_OK;
 }
 
@@ -310,6 +326,7 @@ static NTSTATUS mapiproxy_op_ndr_pull(struct dcesrv_call_state *dce_call, TALLOC
 	const struct ndr_interface_table	*table;
 	uint16_t				opnum;
 	struct dcesrv_mapiproxy_private		*private;
+	struct oc_trace_span			span;
 
 	OC_DEBUG(5, "mapiproxy::mapiproxy_op_ndr_pull");
 
@@ -340,17 +357,30 @@ static NTSTATUS mapiproxy_op_ndr_pull(struct dcesrv_call_state *dce_call, TALLOC
 		return NT_STATUS_NET_WRITE_FAULT;
 	}
 
+	/* The request is traced from its pull to its push */
+	oc_trace_request_begin(table->calls[opnum].name, opnum);
+
 	*r = talloc_size(mem_ctx, table->calls[opnum].struct_size);
 	if (!*r) {
 		return NT_STATUS_NO_MEMORY;
 	}
 
+	oc_trace_span_begin(&span, "mapiproxy_op_ndr_pull", opnum);
+
 	/* directly alter the pull struct before it got pulled from ndr */
-	mapiproxy_module_ndr_pull(dce_call, mem_ctx, pull);
+	if (!private->server_dispatch) {
+		mapiproxy_module_ndr_pull(dce_call, mem_ctx, pull);
+	}
 
+	/* EcDoRpcExt2 buffers and the stream payloads they carry are
+	   views into the stub, which lives as long as the call */
 	ndr_err = table->calls[opnum].ndr_pull(pull, NDR_IN, *r);
 
-	mapiproxy_module_pull(dce_call, mem_ctx, *r);
+	if (!private->server_dispatch) {
+		mapiproxy_module_pull(dce_call, mem_ctx, *r);
+	}
+
+	oc_trace_span_end(&span, ndr_err);
 
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
 		OC_DEBUG(0, "mapiproxy: mapiproxy_ndr_pull: ERROR");
@@ -384,6 +414,7 @@ static NTSTATUS mapiproxy_op_ndr_push(struct dcesrv_call_state *dce_call, TALLOC
 	/* const struct ndr_interface_call		*call; */
 	uint16_t				opnum;
 	/* const char				*name; */
+	struct oc_trace_span			span;
 
 	OC_DEBUG(5, "mapiproxy::mapiproxy_op_ndr_push");
 
@@ -426,16 +457,24 @@ static NTSTATUS mapiproxy_op_ndr_push(struct dcesrv_call_state *dce_call, TALLOC
 		}
 	}
 
-	mapiproxy_module_push(dce_call, mem_ctx, (void *)r);
+	oc_trace_span_begin(&span, "mapiproxy_op_ndr_push", opnum);
+
+	if (!private->server_dispatch) {
+		mapiproxy_module_push(dce_call, mem_ctx, (void *)r);
+	}
 
 	ndr_err = table->calls[opnum].ndr_push(push, NDR_OUT, r);
 
+	oc_trace_span_end(&span, ndr_err);
+
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
 		OC_DEBUG(0, "mapiproxy: mapiproxy_ndr_push: ERROR");
 		dce_call->fault_code = DCERPC_FAULT_NDR;
+		oc_trace_request_end(dce_call->fault_code);
 		return NT_STATUS_NET_WRITE_FAULT;
 	}
 
+	oc_trace_request_end(0);
 	return NT_STATUS_OK;
 }
 
@@ -451,7 +490,7 @@ static NTSTATUS mapiproxy_op_ndr_push(struct dcesrv_call_state *dce_call, TALLOC
 
    \return NT_STATUS_OK on success, otherwise NTSTATUS error
  */
-static NTSTATUS mapiproxy_op_dispatch(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_ctx, void *r)
+static NTSTATUS mapiproxy_op_dispatch_call(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_ctx, void *r)
 {
 	struct dcesrv_mapiproxy_private		*private;
 	struct ndr_push				*push;
@@ -465,13 +504,22 @@ static NTSTATUS mapiproxy_op_dispatch(struct dcesrv_call_state *dce_call, TALLOC
 	int					this_dispatch;
 	struct timeval				tv;
 
+	private = dce_call->context->private_data;
+
+	/* Fast path bound in mapiproxy_op_bind */
+	if (private && private->server_dispatch) {
+		mapiproxy.norelay = true;
+		mapiproxy.ahead = false;
+		status = private->server_dispatch(dce_call, mem_ctx, r, &mapiproxy);
+		return NT_STATUS_IS_OK(status) ? NT_STATUS_OK : NT_STATUS_NET_WRITE_FAULT;
+	}
+
 	this_dispatch = dispatch_nbr;
 	dispatch_nbr++;
 
 	gettimeofday(&tv, NULL);
 	OC_DEBUG(5, "mapiproxy::mapiproxy_op_dispatch: [tv=%lu.%.6lu] [#%d start]", tv.tv_sec, tv.tv_usec, this_dispatch);
 
-	private = dce_call->context->private_data;
 	table = dce_call->context->iface->private_data;
 	opnum = dce_call->pkt.u.request.opnum;
 
@@ -565,6 +613,28 @@ static NTSTATUS mapiproxy_op_dispatch(struct dcesrv_call_state *dce_call, TALLOC
 }
 
 
+/**
+   \details Dispatch a call within a span of the current trace
+
+   \param dce_call pointer to the session context
+   \param mem_ctx pointer to the memory context
+   \param r generic pointer to the call mapped data
+
+   \return NT_STATUS_OK on success, otherwise NTSTATUS error
+ */
+static NTSTATUS mapiproxy_op_dispatch(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_ctx, void *r)
+{
+	struct oc_trace_span	span;
+	NTSTATUS		status;
+
+	oc_trace_span_begin(&span, "mapiproxy_op_dispatch", dce_call->pkt.u.request.opnum);
+	status = mapiproxy_op_dispatch_call(dce_call, mem_ctx, r);
+	oc_trace_span_end(&span, NT_STATUS_V(status));
+
+	return status;
+}
+
+
 /**
    \details Register an endpoint
 
@@ -612,6 +682,9 @@ static NTSTATUS mapiproxy_op_init_server(struct dcesrv_context *dce_ctx, const s
 
 	if (initialized == true) return NT_STATUS_OK;
 
+	oc_log_init_options(dce_ctx->lp_ctx);
+	oc_trace_init(dce_ctx->lp_ctx);
+
 	/* Register mapiproxy modules */
 	ret = mapiproxy_module_init(dce_ctx);
 	NT_STATUS_NOT_OK_RETURN(ret);
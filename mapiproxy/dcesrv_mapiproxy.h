@@ -50,6 +50,8 @@ struct dcesrv_mapiproxy_private {
 	bool					connected;
 	bool					ndrdump;
 	struct cli_credentials			*credentials;
+	/* Server called directly when no module hooks the interface */
+	NTSTATUS				(*server_dispatch)(struct dcesrv_call_state *, TALLOC_CTX *, void *, struct mapiproxy *);
 };
 
 enum exchange_handle {
@@ -49,7 +49,20 @@ struct openchangedb_context {
 	enum MAPISTATUS (*lookup_folder_property)(struct openchangedb_context *, uint32_t, uint64_t);
 	enum MAPISTATUS (*set_folder_properties)(struct openchangedb_context *, const char *, uint64_t, struct SRow *);
 	enum MAPISTATUS (*get_folder_property)(TALLOC_CTX *, struct openchangedb_context *, const char *, uint32_t, uint64_t, void **);
+	enum MAPISTATUS (*get_folder_properties)(TALLOC_CTX *, struct openchangedb_context *, const char *, struct SPropTagArray *, uint64_t, void **, enum MAPISTATUS *);
 	enum MAPISTATUS (*get_folder_count)(struct openchangedb_context *, const char *, uint64_t, uint32_t *);
+	enum MAPISTATUS (*get_folder_tree)(TALLOC_CTX *, struct openchangedb_context *, const char *, uint64_t, uint32_t, struct SPropTagArray *, uint32_t *, struct openchangedb_folder_tree_entry **);
+	enum MAPISTATUS (*get_recursive_folder_count)(struct openchangedb_context *, const char *, uint64_t, uint32_t *);
+	enum MAPISTATUS (*set_recursive_folder_count)(struct openchangedb_context *, const char *, uint64_t, uint32_t);
+	enum MAPISTATUS (*update_recursive_folder_counts)(struct openchangedb_context *, const char *, uint32_t, const uint64_t *, int32_t);
+	enum MAPISTATUS (*clear_recursive_folder_counts)(struct openchangedb_context *, const char *, uint32_t, const uint64_t *);
+	enum MAPISTATUS (*get_hierarchy_change_number)(struct openchangedb_context *, const char *, uint64_t, uint64_t *);
+	enum MAPISTATUS (*set_hierarchy_change_numbers)(struct openchangedb_context *, const char *, uint32_t, const uint64_t *, uint64_t);
+	enum MAPISTATUS (*clear_hierarchy_change_numbers)(struct openchangedb_context *, const char *, uint32_t, const uint64_t *);
+	enum MAPISTATUS (*get_message_counts)(struct openchangedb_context *, const char *, uint64_t, uint32_t, struct openchangedb_message_counts *);
+	enum MAPISTATUS (*set_message_counts)(struct openchangedb_context *, const char *, uint64_t, const struct openchangedb_message_counts *);
+	enum MAPISTATUS (*update_message_counts)(struct openchangedb_context *, const char *, uint64_t, const struct openchangedb_message_counts *);
+	enum MAPISTATUS (*clear_message_counts)(struct openchangedb_context *, const char *, uint32_t, const uint64_t *);
 	enum MAPISTATUS (*get_message_count)(struct openchangedb_context *, const char *, uint64_t, uint32_t *, bool);
 	enum MAPISTATUS (*get_system_idx)(struct openchangedb_context *, const char *, uint64_t, int *);
 	enum MAPISTATUS (*set_system_idx)(struct openchangedb_context *, const char *, uint64_t, int);
@@ -608,6 +608,99 @@ static enum MAPISTATUS get_folder_count(struct openchangedb_context *self,
 	return MAPI_E_SUCCESS;
 }
 
+/* Not needed by LDB mailboxes, callers walk the hierarchy */
+static enum MAPISTATUS get_folder_tree(TALLOC_CTX *parent_ctx,
+				       struct openchangedb_context *self,
+				       const char *username, uint64_t fid,
+				       uint32_t max_depth,
+				       struct SPropTagArray *properties,
+				       uint32_t *countp,
+				       struct openchangedb_folder_tree_entry **entriesp)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+/* Recursive folder counts are not stored, callers walk the hierarchy */
+static enum MAPISTATUS get_recursive_folder_count(struct openchangedb_context *self,
+						  const char *username, uint64_t fid,
+						  uint32_t *RowCount)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS set_recursive_folder_count(struct openchangedb_context *self,
+						  const char *username, uint64_t fid,
+						  uint32_t RowCount)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS update_recursive_folder_counts(struct openchangedb_context *self,
+						      const char *username, uint32_t count,
+						      const uint64_t *fids, int32_t delta)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS clear_recursive_folder_counts(struct openchangedb_context *self,
+						     const char *username, uint32_t count,
+						     const uint64_t *fids)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+/* Hierarchy change numbers are not stored, callers walk the hierarchy */
+static enum MAPISTATUS get_hierarchy_change_number(struct openchangedb_context *self,
+						   const char *username, uint64_t fid,
+						   uint64_t *cn)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS set_hierarchy_change_numbers(struct openchangedb_context *self,
+						    const char *username, uint32_t count,
+						    const uint64_t *fids, uint64_t cn)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS clear_hierarchy_change_numbers(struct openchangedb_context *self,
+						      const char *username, uint32_t count,
+						      const uint64_t *fids)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+/* Message counters are not stored either */
+static enum MAPISTATUS get_message_counts(struct openchangedb_context *self,
+					  const char *username, uint64_t fid,
+					  uint32_t max_age,
+					  struct openchangedb_message_counts *counts)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS set_message_counts(struct openchangedb_context *self,
+					  const char *username, uint64_t fid,
+					  const struct openchangedb_message_counts *counts)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS update_message_counts(struct openchangedb_context *self,
+					     const char *username, uint64_t fid,
+					     const struct openchangedb_message_counts *delta)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
+static enum MAPISTATUS clear_message_counts(struct openchangedb_context *self,
+					    const char *username, uint32_t count,
+					    const uint64_t *fids)
+{
+	return MAPI_E_NOT_IMPLEMENTED;
+}
+
 static char *_unknown_property(TALLOC_CTX *mem_ctx, uint32_t proptag)
 {
 	return talloc_asprintf(mem_ctx, "Unknown%.8x", proptag);
@@ -1086,6 +1179,58 @@ static enum MAPISTATUS get_folder_property(TALLOC_CTX *parent_ctx,
 	return MAPI_E_NOT_FOUND;
 }
 
+static enum MAPISTATUS get_folder_properties(TALLOC_CTX *parent_ctx,
+					     struct openchangedb_context *self,
+					     const char *username,
+					     struct SPropTagArray *properties,
+					     uint64_t fid, void **data,
+					     enum MAPISTATUS *retvals)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct ldb_result	*res = NULL;
+	const char * const	attrs[] = { "*", NULL };
+	const char		*PidTagAttr = NULL;
+	uint32_t		i, proptag;
+	int			ret;
+	struct ldb_context	*ldb_ctx = self->data;
+
+	mem_ctx = talloc_named(NULL, 0, "get_folder_properties");
+
+	/* Step 1. Find PidTagFolderId record, once for all properties */
+	ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx),
+			 LDB_SCOPE_SUBTREE, attrs, "(PidTagFolderId=%"PRIu64")", fid);
+	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS || !res->count, MAPI_E_NOT_FOUND, mem_ctx);
+
+	for (i = 0; i < properties->cValues; i++) {
+		proptag = properties->aulPropTag[i];
+		data[i] = NULL;
+		retvals[i] = MAPI_E_NOT_FOUND;
+
+		/* Step 2. Convert proptag into PidTag attribute */
+		PidTagAttr = openchangedb_property_get_attribute(proptag);
+		if (!PidTagAttr) {
+			PidTagAttr = _unknown_property(mem_ctx, proptag);
+		}
+
+		/* Step 3. Ensure the element exists */
+		if (!ldb_msg_find_element(res->msgs[0], PidTagAttr)) continue;
+
+		/* Step 4. Check if this is a "special property", otherwise
+		 * convert the value */
+		data[i] = _get_special_property(parent_ctx, ldb_ctx, res, proptag, PidTagAttr);
+		if (data[i] == NULL) {
+			data[i] = get_property_data(parent_ctx, res, 0, proptag, PidTagAttr);
+		}
+		if (data[i] != NULL) {
+			retvals[i] = MAPI_E_SUCCESS;
+		}
+	}
+
+	talloc_free(mem_ctx);
+
+	return MAPI_E_SUCCESS;
+}
+
 static enum MAPISTATUS set_folder_properties(struct openchangedb_context *self,
 					     const char *username, uint64_t fid,
 					     struct SRow *row)
@@ -2436,7 +2581,20 @@ _PUBLIC_ enum MAPISTATUS openchangedb_ldb_initialize(TALLOC_CTX *mem_ctx,
 	oc_ctx->lookup_folder_property = lookup_folder_property;
 	oc_ctx->set_folder_properties = set_folder_properties;
 	oc_ctx->get_folder_property = get_folder_property;
+	oc_ctx->get_folder_properties = get_folder_properties;
 	oc_ctx->get_folder_count = get_folder_count;
+	oc_ctx->get_folder_tree = get_folder_tree;
+	oc_ctx->get_recursive_folder_count = get_recursive_folder_count;
+	oc_ctx->set_recursive_folder_count = set_recursive_folder_count;
+	oc_ctx->update_recursive_folder_counts = update_recursive_folder_counts;
+	oc_ctx->clear_recursive_folder_counts = clear_recursive_folder_counts;
+	oc_ctx->get_hierarchy_change_number = get_hierarchy_change_number;
+	oc_ctx->set_hierarchy_change_numbers = set_hierarchy_change_numbers;
+	oc_ctx->clear_hierarchy_change_numbers = clear_hierarchy_change_numbers;
+	oc_ctx->get_message_counts = get_message_counts;
+	oc_ctx->set_message_counts = set_message_counts;
+	oc_ctx->update_message_counts = update_message_counts;
+	oc_ctx->clear_message_counts = clear_message_counts;
 	oc_ctx->get_message_count = get_message_count;
 	oc_ctx->get_system_idx = get_system_idx;
 	oc_ctx->set_system_idx = set_system_idx;
@@ -19,17 +19,41 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stdio.h>
+#include <sys/time.h>
+#include <time.h>
+
 #include "openchangedb_logger.h"
 
 #include "../libmapiproxy.h"
 #include "libmapi/libmapi.h"
 #include "libmapi/libmapi_private.h"
 
+/* Users beyond this limit are accounted together */
+#define	OCDB_LOGGER_MAX_USERS	1024
+#define	OCDB_LOGGER_OTHER_USERS	"<other users>"
+
+struct ocdb_logger_entry {
+	struct ocdb_logger_entry		*prev;
+	struct ocdb_logger_entry		*next;
+	const char				*name;
+	struct openchangedb_logger_stats	stats;
+};
 
 struct ocdb_logger_data {
 	int log_level;
 	const char *log_prefix;
 	struct openchangedb_context *backend;
+
+	/* Profiling */
+	bool profiling;
+	uint32_t dump_interval;
+	uint32_t top;
+	time_t last_dump;
+	struct ocdb_logger_entry *functions;
+	struct ocdb_logger_entry *users;
+	uint32_t users_count;
+	FILE *trace;
 };
 
 static struct ocdb_logger_data * _ocdb_logger_data_get(struct openchangedb_context *self)
@@ -37,16 +61,179 @@ static struct ocdb_logger_data * _ocdb_logger_data_get(struct openchangedb_conte
 	return talloc_get_type(self->data, struct ocdb_logger_data);
 }
 
+// v openchangedb profiling ---------------------------------------------------
+
+static int _ocdb_logger_data_destructor(struct ocdb_logger_data *data)
+{
+	if (data->trace) {
+		fclose(data->trace);
+		data->trace = NULL;
+	}
+
+	return 0;
+}
+
+static struct ocdb_logger_entry *_ocdb_logger_entry_lookup(struct ocdb_logger_data *priv_data,
+							   struct ocdb_logger_entry **list,
+							   const char *name, bool create)
+{
+	struct ocdb_logger_entry	*entry;
+
+	for (entry = *list; entry; entry = entry->next) {
+		if (!strcmp(entry->name, name)) {
+			return entry;
+		}
+	}
+
+	if (!create) return NULL;
+
+	entry = talloc_zero(priv_data, struct ocdb_logger_entry);
+	if (!entry) return NULL;
+	entry->name = talloc_strdup(entry, name);
+	if (!entry->name) {
+		talloc_free(entry);
+		return NULL;
+	}
+	DLIST_ADD_END(*list, entry, struct ocdb_logger_entry *);
+
+	return entry;
+}
+
+static void _ocdb_logger_stats_add(struct openchangedb_logger_stats *stats, uint64_t usec)
+{
+	stats->count++;
+	stats->total_usec += usec;
+	if (usec > stats->max_usec) {
+		stats->max_usec = usec;
+	}
+}
+
+/**
+   \details Log the top entries of a list, by total time spent
+ */
+static void _ocdb_logger_dump_top(struct ocdb_logger_data *priv_data, const char *kind,
+				  struct ocdb_logger_entry *list)
+{
+	struct ocdb_logger_entry	*entry;
+	struct ocdb_logger_entry	**top;
+	uint32_t			count = 0, i, j;
+
+	top = talloc_zero_array(priv_data, struct ocdb_logger_entry *, priv_data->top);
+	if (!top) return;
+
+	/* Insertion into the array of the slowest entries seen so far */
+	for (entry = list; entry; entry = entry->next) {
+		for (i = 0; i < count; i++) {
+			if (entry->stats.total_usec > top[i]->stats.total_usec) break;
+		}
+		if (i >= priv_data->top) continue;
+		if (count < priv_data->top) count++;
+		for (j = count - 1; j > i; j--) {
+			top[j] = top[j - 1];
+		}
+		top[i] = entry;
+	}
+
+	for (i = 0; i < count; i++) {
+		entry = top[i];
+		OC_DEBUG(0, "%sprofile: %s %s: %"PRIu64" calls, total %"PRIu64" us, avg %"PRIu64" us, max %"PRIu64" us",
+			 priv_data->log_prefix, kind, entry->name, entry->stats.count, entry->stats.total_usec,
+			 entry->stats.total_usec / entry->stats.count, entry->stats.max_usec);
+	}
+
+	talloc_free(top);
+}
+
+static void _ocdb_logger_dump(struct ocdb_logger_data *priv_data)
+{
+	priv_data->last_dump = time(NULL);
+	if (!priv_data->functions) return;
+
+	OC_DEBUG(0, "%sprofile: top %"PRIu32" functions and users by time spent in the backend",
+		 priv_data->log_prefix, priv_data->top);
+	_ocdb_logger_dump_top(priv_data, "function", priv_data->functions);
+	_ocdb_logger_dump_top(priv_data, "user", priv_data->users);
+}
+
+static void _ocdb_logger_profile_start(struct ocdb_logger_data *priv_data, struct timespec *start)
+{
+	if (!priv_data->profiling && !priv_data->trace) return;
+
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+/**
+   \details Account a call made to the backend and dump the profile
+   once the dump interval elapsed
+
+   \param priv_data pointer to the logger data
+   \param function the name of the backend function called
+   \param username the user the call was made for, if any
+   \param start pointer to the timestamp taken before the call
+ */
+static void _ocdb_logger_profile_end(struct ocdb_logger_data *priv_data, const char *function,
+				     const char *username, const struct timespec *start)
+{
+	struct ocdb_logger_entry	*entry;
+	struct timespec			end;
+	struct timeval			now;
+	uint64_t			usec;
+
+	if (!priv_data->profiling && !priv_data->trace) return;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usec = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000 +
+		(end.tv_nsec - start->tv_nsec) / 1000;
+
+	if (priv_data->trace) {
+		gettimeofday(&now, NULL);
+		fprintf(priv_data->trace, "%ld.%06ld\t%s\t%s\t%"PRIu64"\n",
+			(long) now.tv_sec, (long) now.tv_usec, function,
+			username ? username : "-", usec);
+	}
+
+	if (!priv_data->profiling) return;
+
+	entry = _ocdb_logger_entry_lookup(priv_data, &priv_data->functions, function, true);
+	if (entry) {
+		_ocdb_logger_stats_add(&entry->stats, usec);
+	}
+
+	if (username) {
+		entry = _ocdb_logger_entry_lookup(priv_data, &priv_data->users, username, false);
+		if (!entry) {
+			if (priv_data->users_count >= OCDB_LOGGER_MAX_USERS) {
+				username = OCDB_LOGGER_OTHER_USERS;
+			} else {
+				priv_data->users_count++;
+			}
+			entry = _ocdb_logger_entry_lookup(priv_data, &priv_data->users, username, true);
+		}
+		if (entry) {
+			_ocdb_logger_stats_add(&entry->stats, usec);
+		}
+	}
+
+	if (priv_data->dump_interval && time(NULL) - priv_data->last_dump >= priv_data->dump_interval) {
+		_ocdb_logger_dump(priv_data);
+	}
+}
+
+// ^ openchangedb profiling ---------------------------------------------------
+
 static enum MAPISTATUS get_SpecialFolderID(struct openchangedb_context *self,
 					  const char *recipient, uint32_t system_idx,
 					  uint64_t *folder_id)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s], system_idx=[0x%08"PRIx32"]",
 					priv_data->log_prefix, recipient, system_idx);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_SpecialFolderID(priv_data->backend, recipient, system_idx, folder_id);
+	_ocdb_logger_profile_end(priv_data, "get_SpecialFolderID", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], folder_id=[0x%016"PRIx64"]",
 					priv_data->log_prefix, mapi_get_errstr(retval), *folder_id);
 
@@ -58,11 +245,14 @@ static enum MAPISTATUS get_SystemFolderID(struct openchangedb_context *self,
 					  uint64_t *FolderId)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s], system_idx=[0x%08"PRIx32"]",
 					priv_data->log_prefix, recipient, SystemIdx);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_SystemFolderID(priv_data->backend, recipient, SystemIdx, FolderId);
+	_ocdb_logger_profile_end(priv_data, "get_SystemFolderID", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], folder_id=[0x%016"PRIx64"]",
 					priv_data->log_prefix, mapi_get_errstr(retval), *FolderId);
 
@@ -75,11 +265,14 @@ static enum MAPISTATUS get_PublicFolderID(struct openchangedb_context *self,
 					  uint64_t *FolderId)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], system_idx=[0x%08"PRIx32"]",
 					priv_data->log_prefix, username, SystemIdx);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_PublicFolderID(priv_data->backend, username, SystemIdx, FolderId);
+	_ocdb_logger_profile_end(priv_data, "get_PublicFolderID", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], folder_id=[0x%016"PRIx64"]",
 					priv_data->log_prefix, mapi_get_errstr(retval), *FolderId);
 
@@ -92,11 +285,14 @@ static enum MAPISTATUS get_distinguishedName(TALLOC_CTX *parent_ctx,
 					     char **distinguishedName)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: system_idx=[0x%016"PRIx64"]",
 					priv_data->log_prefix, fid);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_distinguishedName(parent_ctx, priv_data->backend, fid, distinguishedName);
+	_ocdb_logger_profile_end(priv_data, "get_distinguishedName", NULL, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], distinguishedName=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval), *distinguishedName);
 
@@ -108,11 +304,14 @@ static enum MAPISTATUS get_MailboxGuid(struct openchangedb_context *self,
 				       struct GUID *MailboxGUID)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s]",
 					priv_data->log_prefix, recipient);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_MailboxGuid(priv_data->backend, recipient, MailboxGUID);
+	_ocdb_logger_profile_end(priv_data, "get_MailboxGuid", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -124,11 +323,14 @@ static enum MAPISTATUS get_MailboxReplica(struct openchangedb_context *self,
 				  	  struct GUID *ReplGUID)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s]",
 					priv_data->log_prefix, recipient);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_MailboxReplica(priv_data->backend, recipient, ReplID, ReplGUID);
+	_ocdb_logger_profile_end(priv_data, "get_MailboxReplica", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -141,11 +343,14 @@ static enum MAPISTATUS get_PublicFolderReplica(struct openchangedb_context *self
 					       struct GUID *ReplGUID)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 				     priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_PublicFolderReplica(priv_data->backend, username, ReplID, ReplGUID);
+	_ocdb_logger_profile_end(priv_data, "get_PublicFolderReplica", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -159,11 +364,14 @@ static enum MAPISTATUS get_mapistoreURI(TALLOC_CTX *parent_ctx,
 				        bool mailboxstore)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%016"PRIx64"]",
 					priv_data->log_prefix, username, fid);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_mapistoreURI(parent_ctx, priv_data->backend, username, fid, mapistoreURL, mailboxstore);
+	_ocdb_logger_profile_end(priv_data, "get_mapistoreURI", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], mapistoreURL=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval),
 					retval == MAPI_E_SUCCESS ? *mapistoreURL : "undefined");
@@ -176,11 +384,14 @@ static enum MAPISTATUS set_mapistoreURI(struct openchangedb_context *self,
 					const char *mapistoreURL)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%016"PRIx64"], mapistoreURL=[%s]",
 					priv_data->log_prefix, username, fid, mapistoreURL);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->set_mapistoreURI(priv_data->backend, username, fid, mapistoreURL);
+	_ocdb_logger_profile_end(priv_data, "set_mapistoreURI", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -192,11 +403,14 @@ static enum MAPISTATUS get_parent_fid(struct openchangedb_context *self,
 				      uint64_t *parent_fidp, bool mailboxstore)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%016"PRIx64"]",
 					priv_data->log_prefix, username, fid);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_parent_fid(priv_data->backend, username, fid, parent_fidp, mailboxstore);
+	_ocdb_logger_profile_end(priv_data, "get_parent_fid", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], parent_fid=[0x%016"PRIx64"]",
 					priv_data->log_prefix, mapi_get_errstr(retval), *parent_fidp);
 
@@ -207,11 +421,14 @@ static enum MAPISTATUS get_fid(struct openchangedb_context *self,
 			       const char *mapistoreURL, uint64_t *fidp)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: mapistoreURL=[%s]",
 					priv_data->log_prefix, mapistoreURL);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_fid(priv_data->backend, mapistoreURL, fidp);
+	_ocdb_logger_profile_end(priv_data, "get_fid", NULL, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], fid=[0x%016"PRIx64"]",
 					priv_data->log_prefix, mapi_get_errstr(retval), *fidp);
 
@@ -224,11 +441,14 @@ static enum MAPISTATUS get_MAPIStoreURIs(struct openchangedb_context *self,
 					 struct StringArrayW_r **urisP)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_MAPIStoreURIs(priv_data->backend, username, mem_ctx, urisP);
+	_ocdb_logger_profile_end(priv_data, "get_MAPIStoreURIs", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -243,11 +463,14 @@ static enum MAPISTATUS get_ReceiveFolder(TALLOC_CTX *parent_ctx,
 					 const char **ExplicitMessageClass)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s]",
 					priv_data->log_prefix, recipient);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_ReceiveFolder(parent_ctx, priv_data->backend, recipient, MessageClass, fid, ExplicitMessageClass);
+	_ocdb_logger_profile_end(priv_data, "get_ReceiveFolder", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -261,12 +484,15 @@ static enum MAPISTATUS get_ReceiveFolderTable(TALLOC_CTX *parent_ctx,
 					      struct ReceiveFolder **entries)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s]",
 					priv_data->log_prefix, recipient);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_ReceiveFolderTable(parent_ctx, priv_data->backend,
 							    recipient, cValues, entries);
+	_ocdb_logger_profile_end(priv_data, "get_ReceiveFolderTable", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], cValues=[%d]",
 		 priv_data->log_prefix, mapi_get_errstr(retval),
 		 (retval == MAPI_E_SUCCESS && cValues) ? *cValues : -1);
@@ -279,11 +505,14 @@ static enum MAPISTATUS get_TransportFolder(struct openchangedb_context *self,
 					   uint64_t *FolderId)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s]",
 					priv_data->log_prefix, recipient);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_TransportFolder(priv_data->backend, recipient, FolderId);
+	_ocdb_logger_profile_end(priv_data, "get_TransportFolder", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -295,11 +524,248 @@ static enum MAPISTATUS get_folder_count(struct openchangedb_context *self,
 					uint32_t *RowCount)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_folder_count(priv_data->backend, username, fid, RowCount);
+	_ocdb_logger_profile_end(priv_data, "get_folder_count", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS get_folder_tree(TALLOC_CTX *parent_ctx,
+				       struct openchangedb_context *self,
+				       const char *username, uint64_t fid,
+				       uint32_t max_depth,
+				       struct SPropTagArray *properties,
+				       uint32_t *countp,
+				       struct openchangedb_folder_tree_entry **entriesp)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"], max_depth=[%u]",
+					priv_data->log_prefix, username, fid, max_depth);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->get_folder_tree(parent_ctx, priv_data->backend, username, fid, max_depth,
+						     properties, countp, entriesp);
+	_ocdb_logger_profile_end(priv_data, "get_folder_tree", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS get_recursive_folder_count(struct openchangedb_context *self,
+						  const char *username, uint64_t fid,
+						  uint32_t *RowCount)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"]",
+					priv_data->log_prefix, username, fid);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->get_recursive_folder_count(priv_data->backend, username, fid, RowCount);
+	_ocdb_logger_profile_end(priv_data, "get_recursive_folder_count", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS set_recursive_folder_count(struct openchangedb_context *self,
+						  const char *username, uint64_t fid,
+						  uint32_t RowCount)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"], count=[%u]",
+					priv_data->log_prefix, username, fid, RowCount);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->set_recursive_folder_count(priv_data->backend, username, fid, RowCount);
+	_ocdb_logger_profile_end(priv_data, "set_recursive_folder_count", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS update_recursive_folder_counts(struct openchangedb_context *self,
+						      const char *username, uint32_t count,
+						      const uint64_t *fids, int32_t delta)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], count=[%u], delta=[%d]",
+					priv_data->log_prefix, username, count, delta);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->update_recursive_folder_counts(priv_data->backend, username, count, fids, delta);
+	_ocdb_logger_profile_end(priv_data, "update_recursive_folder_counts", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS clear_recursive_folder_counts(struct openchangedb_context *self,
+						     const char *username, uint32_t count,
+						     const uint64_t *fids)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], count=[%u]",
+					priv_data->log_prefix, username, count);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->clear_recursive_folder_counts(priv_data->backend, username, count, fids);
+	_ocdb_logger_profile_end(priv_data, "clear_recursive_folder_counts", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS get_hierarchy_change_number(struct openchangedb_context *self,
+						   const char *username, uint64_t fid,
+						   uint64_t *cn)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"]",
+					priv_data->log_prefix, username, fid);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->get_hierarchy_change_number(priv_data->backend, username, fid, cn);
+	_ocdb_logger_profile_end(priv_data, "get_hierarchy_change_number", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS set_hierarchy_change_numbers(struct openchangedb_context *self,
+						    const char *username, uint32_t count,
+						    const uint64_t *fids, uint64_t cn)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], count=[%u], cn=[0x%"PRIx64"]",
+					priv_data->log_prefix, username, count, cn);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->set_hierarchy_change_numbers(priv_data->backend, username, count, fids, cn);
+	_ocdb_logger_profile_end(priv_data, "set_hierarchy_change_numbers", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS clear_hierarchy_change_numbers(struct openchangedb_context *self,
+						      const char *username, uint32_t count,
+						      const uint64_t *fids)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], count=[%u]",
+					priv_data->log_prefix, username, count);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->clear_hierarchy_change_numbers(priv_data->backend, username, count, fids);
+	_ocdb_logger_profile_end(priv_data, "clear_hierarchy_change_numbers", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS get_message_counts(struct openchangedb_context *self,
+					  const char *username, uint64_t fid,
+					  uint32_t max_age,
+					  struct openchangedb_message_counts *counts)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"], max_age=[%u]",
+					priv_data->log_prefix, username, fid, max_age);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->get_message_counts(priv_data->backend, username, fid, max_age, counts);
+	_ocdb_logger_profile_end(priv_data, "get_message_counts", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS set_message_counts(struct openchangedb_context *self,
+					  const char *username, uint64_t fid,
+					  const struct openchangedb_message_counts *counts)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"], messages=[%"PRId64"]",
+					priv_data->log_prefix, username, fid, counts->messages);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->set_message_counts(priv_data->backend, username, fid, counts);
+	_ocdb_logger_profile_end(priv_data, "set_message_counts", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS update_message_counts(struct openchangedb_context *self,
+					     const char *username, uint64_t fid,
+					     const struct openchangedb_message_counts *delta)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%"PRIx64"], messages=[%"PRId64"]",
+					priv_data->log_prefix, username, fid, delta->messages);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->update_message_counts(priv_data->backend, username, fid, delta);
+	_ocdb_logger_profile_end(priv_data, "update_message_counts", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS clear_message_counts(struct openchangedb_context *self,
+					    const char *username, uint32_t count,
+					    const uint64_t *fids)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], count=[%u]",
+					priv_data->log_prefix, username, count);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = priv_data->backend->clear_message_counts(priv_data->backend, username, count, fids);
+	_ocdb_logger_profile_end(priv_data, "clear_message_counts", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -310,11 +776,14 @@ static enum MAPISTATUS lookup_folder_property(struct openchangedb_context *self,
 					      uint32_t proptag, uint64_t fid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: ",
 					priv_data->log_prefix);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->lookup_folder_property(priv_data->backend, proptag, fid);
+	_ocdb_logger_profile_end(priv_data, "lookup_folder_property", NULL, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -325,11 +794,14 @@ static enum MAPISTATUS get_new_changeNumber(struct openchangedb_context *self,
 					    const char *username, uint64_t *cn)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_new_changeNumber(priv_data->backend, username, cn);
+	_ocdb_logger_profile_end(priv_data, "get_new_changeNumber", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s] cn=[0x%016"PRIx64"]",
 		 priv_data->log_prefix, mapi_get_errstr(retval),
 		 (retval == MAPI_E_SUCCESS) ? *cn : 0);
@@ -344,11 +816,14 @@ static enum MAPISTATUS get_new_changeNumbers(struct openchangedb_context *self,
 					     struct UI8Array_r **cns_p)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], max=[0x%016"PRIx64"]",
 				     priv_data->log_prefix, username, max);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_new_changeNumbers(priv_data->backend, mem_ctx, username, max, cns_p);
+	_ocdb_logger_profile_end(priv_data, "get_new_changeNumbers", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s] last_cn=[0x%016"PRIx64"]",
 		 priv_data->log_prefix, mapi_get_errstr(retval),
 		 (retval == MAPI_E_SUCCESS) ? (*cns_p)->lpui8[max - 1] : 0);
@@ -361,11 +836,14 @@ static enum MAPISTATUS get_next_changeNumber(struct openchangedb_context *self,
 					     uint64_t *cn)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 				     priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_next_changeNumber(priv_data->backend, username, cn);
+	_ocdb_logger_profile_end(priv_data, "get_next_changeNumber", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], cn=[0x%016"PRIx64"]",
 				     priv_data->log_prefix, mapi_get_errstr(retval), *cn);
 
@@ -379,11 +857,36 @@ static enum MAPISTATUS get_folder_property(TALLOC_CTX *parent_ctx,
 					   void **data)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_folder_property(parent_ctx, priv_data->backend, username, proptag, fid, data);
+	_ocdb_logger_profile_end(priv_data, "get_folder_property", username, &start);
+	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
+					priv_data->log_prefix, mapi_get_errstr(retval));
+
+	return retval;
+}
+
+static enum MAPISTATUS get_folder_properties(TALLOC_CTX *parent_ctx,
+					     struct openchangedb_context *self,
+					     const char *username,
+					     struct SPropTagArray *properties,
+					     uint64_t fid, void **data,
+					     enum MAPISTATUS *retvals)
+{
+	enum MAPISTATUS retval;
+	struct timespec start;
+	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
+
+	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], fid=[0x%016"PRIx64"], count=[%"PRIu32"]",
+					priv_data->log_prefix, username, fid, properties->cValues);
+	_ocdb_logger_profile_start(priv_data, &start);
+	retval = openchangedb_get_folder_properties(parent_ctx, priv_data->backend, username, properties, fid, data, retvals);
+	_ocdb_logger_profile_end(priv_data, "get_folder_properties", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -395,11 +898,14 @@ static enum MAPISTATUS set_folder_properties(struct openchangedb_context *self,
 					     struct SRow *row)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->set_folder_properties(priv_data->backend, username, fid, row);
+	_ocdb_logger_profile_end(priv_data, "set_folder_properties", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -413,9 +919,12 @@ static enum MAPISTATUS get_table_property(TALLOC_CTX *parent_ctx,
 					  void **data)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_table_property(parent_ctx, priv_data->backend, ldb_filter, proptag, pos, data);
+	_ocdb_logger_profile_end(priv_data, "get_table_property", NULL, &start);
 
 	return retval;
 }
@@ -426,11 +935,14 @@ static enum MAPISTATUS get_fid_by_name(struct openchangedb_context *self,
 				       const char* foldername, uint64_t *fid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], parent_fid=[0x%016"PRIx64"], foldername=[%s]",
 					priv_data->log_prefix, username, parent_fid, foldername);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_fid_by_name(priv_data->backend, username, parent_fid, foldername, fid);
+	_ocdb_logger_profile_end(priv_data, "get_fid_by_name", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -444,11 +956,14 @@ static enum MAPISTATUS get_mid_by_subject(struct openchangedb_context *self,
 					  bool mailboxstore, uint64_t *mid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_mid_by_subject(priv_data->backend, username, parent_fid, subject, mailboxstore, mid);
+	_ocdb_logger_profile_end(priv_data, "get_mid_by_subject", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -459,11 +974,14 @@ static enum MAPISTATUS delete_folder(struct openchangedb_context *self,
 				     const char *username, uint64_t fid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->delete_folder(priv_data->backend, username, fid);
+	_ocdb_logger_profile_end(priv_data, "delete_folder", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -475,11 +993,14 @@ static enum MAPISTATUS set_ReceiveFolder(struct openchangedb_context *self,
 					 const char *MessageClass, uint64_t fid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: recipient=[%s]",
 					priv_data->log_prefix, recipient);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->set_ReceiveFolder(priv_data->backend, recipient, MessageClass, fid);
+	_ocdb_logger_profile_end(priv_data, "set_ReceiveFolder", recipient, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -490,9 +1011,12 @@ static enum MAPISTATUS get_fid_from_partial_uri(struct openchangedb_context *sel
 						const char *partialURI, uint64_t *fid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_fid_from_partial_uri(priv_data->backend, partialURI, fid);
+	_ocdb_logger_profile_end(priv_data, "get_fid_from_partial_uri", NULL, &start);
 
 	return retval;
 }
@@ -505,9 +1029,12 @@ static enum MAPISTATUS get_users_from_partial_uri(TALLOC_CTX *parent_ctx,
 						  char ***users)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_users_from_partial_uri(parent_ctx, priv_data->backend, partialURI, count, MAPIStoreURI, users);
+	_ocdb_logger_profile_end(priv_data, "get_users_from_partial_uri", NULL, &start);
 
 	return retval;
 }
@@ -520,6 +1047,7 @@ static enum MAPISTATUS create_mailbox(struct openchangedb_context *self,
 				      const char *display_name)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s], org_name=[%s], groupo_name=[%s],"
@@ -527,9 +1055,11 @@ static enum MAPISTATUS create_mailbox(struct openchangedb_context *self,
 				     priv_data->log_prefix,
 				     username, organization_name, groupo_name,
 				     systemIdx, fid, display_name);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->create_mailbox(priv_data->backend, username,
 						    organization_name, groupo_name,
 						    systemIdx, fid, display_name);
+	_ocdb_logger_profile_end(priv_data, "create_mailbox", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 				     priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -543,11 +1073,14 @@ static enum MAPISTATUS create_folder(struct openchangedb_context *self,
 				     const char *MAPIStoreURI, int systemIdx)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->create_folder(priv_data->backend, username, parentFolderID, fid, changeNumber, MAPIStoreURI, systemIdx);
+	_ocdb_logger_profile_end(priv_data, "create_folder", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -559,11 +1092,14 @@ static enum MAPISTATUS get_message_count(struct openchangedb_context *self,
 					 uint32_t *RowCount, bool fai)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_message_count(priv_data->backend, username, fid, RowCount, fai);
+	_ocdb_logger_profile_end(priv_data, "get_message_count", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -575,11 +1111,14 @@ static enum MAPISTATUS get_system_idx(struct openchangedb_context *self,
 				      int *system_idx_p)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_system_idx(priv_data->backend, username, fid, system_idx_p);
+	_ocdb_logger_profile_end(priv_data, "get_system_idx", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], system_idx=[%d]",
 		 priv_data->log_prefix, mapi_get_errstr(retval),
 		 retval == MAPI_E_SUCCESS ? *system_idx_p : -1);
@@ -592,11 +1131,14 @@ static enum MAPISTATUS set_system_idx(struct openchangedb_context *self,
 				      int system_idx)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s] system_idx=[%d]",
 		 priv_data->log_prefix, username, system_idx);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->set_system_idx(priv_data->backend, username, fid, system_idx);
+	_ocdb_logger_profile_end(priv_data, "set_system_idx", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -606,9 +1148,12 @@ static enum MAPISTATUS set_system_idx(struct openchangedb_context *self,
 static enum MAPISTATUS transaction_start(struct openchangedb_context *self)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->transaction_start(priv_data->backend);
+	_ocdb_logger_profile_end(priv_data, "transaction_start", NULL, &start);
 
 	return retval;
 }
@@ -616,9 +1161,12 @@ static enum MAPISTATUS transaction_start(struct openchangedb_context *self)
 static enum MAPISTATUS transaction_commit(struct openchangedb_context *self)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->transaction_commit(priv_data->backend);
+	_ocdb_logger_profile_end(priv_data, "transaction_commit", NULL, &start);
 
 	return retval;
 }
@@ -628,11 +1176,14 @@ static enum MAPISTATUS get_new_public_folderID(struct openchangedb_context *self
 					       uint64_t *fid)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_new_public_folderID(priv_data->backend, username, fid);
+	_ocdb_logger_profile_end(priv_data, "get_new_public_folderID", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -642,9 +1193,12 @@ static enum MAPISTATUS get_new_public_folderID(struct openchangedb_context *self
 static bool is_public_folder_id(struct openchangedb_context *self, uint64_t fid)
 {
 	bool ret;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	ret = priv_data->backend->is_public_folder_id(priv_data->backend, fid);
+	_ocdb_logger_profile_end(priv_data, "is_public_folder_id", NULL, &start);
 
 	return ret;
 }
@@ -654,11 +1208,14 @@ static enum MAPISTATUS get_indexing_url(struct openchangedb_context *self,
 					const char **indexing_url)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 				     priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->get_indexing_url(priv_data->backend, username, indexing_url);
+	_ocdb_logger_profile_end(priv_data, "get_indexing_url", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s], indexing_url=[%s]",
 				     priv_data->log_prefix, mapi_get_errstr(retval),
 				     *indexing_url);
@@ -669,11 +1226,14 @@ static enum MAPISTATUS get_indexing_url(struct openchangedb_context *self,
 static bool set_locale(struct openchangedb_context *self, const char *username, uint32_t lcid)
 {
 	bool ret;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	ret = priv_data->backend->set_locale(priv_data->backend, username, lcid);
+	_ocdb_logger_profile_end(priv_data, "set_locale", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: ret=[%d]",
 					priv_data->log_prefix, ret);
 
@@ -683,9 +1243,12 @@ static bool set_locale(struct openchangedb_context *self, const char *username,
 static const char **get_folders_names(TALLOC_CTX *mem_ctx, struct openchangedb_context *self, const char *locale, const char *type)
 {
 	const char **names;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	names = priv_data->backend->get_folders_names(mem_ctx, priv_data->backend, locale, type);
+	_ocdb_logger_profile_end(priv_data, "get_folders_names", NULL, &start);
 
 	return names;
 }
@@ -700,11 +1263,14 @@ static enum MAPISTATUS table_init(TALLOC_CTX *mem_ctx,
 				  void **table_object)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->table_init(mem_ctx, priv_data->backend, username, table_type, folderID, table_object);
+	_ocdb_logger_profile_end(priv_data, "table_init", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -716,9 +1282,12 @@ static enum MAPISTATUS table_set_sort_order(struct openchangedb_context *self,
 					    struct SSortOrderSet *lpSortCriteria)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->table_set_sort_order(priv_data->backend, table_object, lpSortCriteria);
+	_ocdb_logger_profile_end(priv_data, "table_set_sort_order", NULL, &start);
 
 	return retval;
 }
@@ -728,9 +1297,12 @@ static enum MAPISTATUS table_set_restrictions(struct openchangedb_context *self,
 					      struct mapi_SRestriction *res)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->table_set_restrictions(priv_data->backend, table_object, res);
+	_ocdb_logger_profile_end(priv_data, "table_set_restrictions", NULL, &start);
 
 	return retval;
 }
@@ -742,9 +1314,12 @@ static enum MAPISTATUS table_get_property(TALLOC_CTX *mem_ctx,
 					  bool live_filtered, void **data)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->table_get_property(mem_ctx, priv_data->backend, table_object, proptag, pos, live_filtered, data);
+	_ocdb_logger_profile_end(priv_data, "table_get_property", NULL, &start);
 
 	return retval;
 }
@@ -760,11 +1335,14 @@ static enum MAPISTATUS message_create(TALLOC_CTX *mem_ctx,
 				      bool fai, void **message_object)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]",
 					priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->message_create(mem_ctx, priv_data->backend, username, messageID, folderID, fai, message_object);
+	_ocdb_logger_profile_end(priv_data, "message_create", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]",
 					priv_data->log_prefix, mapi_get_errstr(retval));
 
@@ -775,10 +1353,13 @@ static enum MAPISTATUS message_save(struct openchangedb_context *self,
 				    void *_msg, uint8_t SaveFlags)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: ", priv_data->log_prefix);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->message_save(priv_data->backend, _msg, SaveFlags);
+	_ocdb_logger_profile_end(priv_data, "message_save", NULL, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]", priv_data->log_prefix, mapi_get_errstr(retval));
 
 	return retval;
@@ -791,10 +1372,13 @@ static enum MAPISTATUS message_open(TALLOC_CTX *mem_ctx,
 				    void **message_object, void **msgp)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]: username=[%s]", priv_data->log_prefix, username);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->message_open(mem_ctx, priv_data->backend, username, messageID, folderID, message_object, msgp);
+	_ocdb_logger_profile_end(priv_data, "message_open", username, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]", priv_data->log_prefix, mapi_get_errstr(retval));
 
 	return retval;
@@ -806,10 +1390,13 @@ static enum MAPISTATUS message_get_property(TALLOC_CTX *mem_ctx,
 					    uint32_t proptag, void **data)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]", priv_data->log_prefix);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->message_get_property(mem_ctx, priv_data->backend, message_object, proptag, data);
+	_ocdb_logger_profile_end(priv_data, "message_get_property", NULL, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]", priv_data->log_prefix, mapi_get_errstr(retval));
 
 	return retval;
@@ -821,10 +1408,13 @@ static enum MAPISTATUS message_set_properties(TALLOC_CTX *mem_ctx,
 					      struct SRow *row)
 {
 	enum MAPISTATUS retval;
+	struct timespec start;
 	struct ocdb_logger_data *priv_data = _ocdb_logger_data_get(self);
 
 	OC_DEBUG(priv_data->log_level, "%s[in]", priv_data->log_prefix);
+	_ocdb_logger_profile_start(priv_data, &start);
 	retval = priv_data->backend->message_set_properties(mem_ctx, priv_data->backend, message_object, row);
+	_ocdb_logger_profile_end(priv_data, "message_set_properties", NULL, &start);
 	OC_DEBUG(priv_data->log_level, "%s[out]: retval=[%s]", priv_data->log_prefix, mapi_get_errstr(retval));
 
 	return retval;
@@ -850,6 +1440,7 @@ _PUBLIC_ enum MAPISTATUS openchangedb_logger_initialize(TALLOC_CTX *mem_ctx,
 	data->log_prefix = log_prefix ? talloc_strdup(oc_ctx, log_prefix) : "";
 
 	oc_ctx->data = data;
+	talloc_set_destructor(data, _ocdb_logger_data_destructor);
 
 	// Initialize struct with function pointers
 	oc_ctx->backend_type = talloc_strdup(oc_ctx, "logger_module");
@@ -876,7 +1467,20 @@ _PUBLIC_ enum MAPISTATUS openchangedb_logger_initialize(TALLOC_CTX *mem_ctx,
 	oc_ctx->lookup_folder_property = lookup_folder_property;
 	oc_ctx->set_folder_properties = set_folder_properties;
 	oc_ctx->get_folder_property = get_folder_property;
+	oc_ctx->get_folder_properties = get_folder_properties;
 	oc_ctx->get_folder_count = get_folder_count;
+	oc_ctx->get_folder_tree = get_folder_tree;
+	oc_ctx->get_recursive_folder_count = get_recursive_folder_count;
+	oc_ctx->set_recursive_folder_count = set_recursive_folder_count;
+	oc_ctx->update_recursive_folder_counts = update_recursive_folder_counts;
+	oc_ctx->clear_recursive_folder_counts = clear_recursive_folder_counts;
+	oc_ctx->get_hierarchy_change_number = get_hierarchy_change_number;
+	oc_ctx->set_hierarchy_change_numbers = set_hierarchy_change_numbers;
+	oc_ctx->clear_hierarchy_change_numbers = clear_hierarchy_change_numbers;
+	oc_ctx->get_message_counts = get_message_counts;
+	oc_ctx->set_message_counts = set_message_counts;
+	oc_ctx->update_message_counts = update_message_counts;
+	oc_ctx->clear_message_counts = clear_message_counts;
 	oc_ctx->get_message_count = get_message_count;
 	oc_ctx->get_system_idx = get_system_idx;
 	oc_ctx->set_system_idx = set_system_idx;
@@ -915,3 +1519,112 @@ _PUBLIC_ enum MAPISTATUS openchangedb_logger_initialize(TALLOC_CTX *mem_ctx,
 
 	return MAPI_E_SUCCESS;
 }
+
+/**
+   \details Enable the profiling of the calls made through a logger
+   context
+
+   Every call is timed and accounted per backend function and per
+   user. The functions and users the backend spent the most time on
+   are logged every dump_interval seconds.
+
+   \param ctx pointer to the logger context
+   \param dump_interval the number of seconds between two dumps of the
+   profile, 0 to only dump it with openchangedb_logger_dump_profile
+   \param top the number of functions and users to dump
+   \param trace_path the path of a file each call is appended to, with
+   its timestamp, function, user and latency in microseconds. NULL
+   disables the trace.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_logger_set_profiling(struct openchangedb_context *ctx,
+							   uint32_t dump_interval,
+							   uint32_t top,
+							   const char *trace_path)
+{
+	struct ocdb_logger_data	*priv_data;
+	FILE			*trace = NULL;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	priv_data = talloc_get_type(ctx->data, struct ocdb_logger_data);
+	OPENCHANGE_RETVAL_IF(!priv_data, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (trace_path) {
+		trace = fopen(trace_path, "a");
+		if (!trace) {
+			OC_DEBUG(0, "Unable to open openchangedb trace file %s: %s", trace_path, strerror(errno));
+			return MAPI_E_NO_ACCESS;
+		}
+		setvbuf(trace, NULL, _IOLBF, 0);
+	}
+	if (priv_data->trace) {
+		fclose(priv_data->trace);
+	}
+
+	priv_data->profiling = true;
+	priv_data->dump_interval = dump_interval;
+	priv_data->top = top;
+	priv_data->last_dump = time(NULL);
+	priv_data->trace = trace;
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Retrieve the profile of a backend function or of a user
+
+   \param ctx pointer to the logger context
+   \param function the name of the backend function, NULL to retrieve
+   the profile of username
+   \param username the user to retrieve the profile of, if function is
+   NULL
+   \param stats pointer to the counters to fill
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if no call was
+   accounted, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_logger_get_stats(struct openchangedb_context *ctx,
+						       const char *function,
+						       const char *username,
+						       struct openchangedb_logger_stats *stats)
+{
+	struct ocdb_logger_data		*priv_data;
+	struct ocdb_logger_entry	*entry;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!function && !username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!stats, MAPI_E_INVALID_PARAMETER, NULL);
+	priv_data = talloc_get_type(ctx->data, struct ocdb_logger_data);
+	OPENCHANGE_RETVAL_IF(!priv_data, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (function) {
+		entry = _ocdb_logger_entry_lookup(priv_data, &priv_data->functions, function, false);
+	} else {
+		entry = _ocdb_logger_entry_lookup(priv_data, &priv_data->users, username, false);
+	}
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_FOUND, NULL);
+
+	*stats = entry->stats;
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Log the functions and users the backend spent the most time
+   on so far
+
+   \param ctx pointer to the logger context
+ */
+_PUBLIC_ void openchangedb_logger_dump_profile(struct openchangedb_context *ctx)
+{
+	struct ocdb_logger_data	*priv_data;
+
+	if (!ctx) return;
+	priv_data = talloc_get_type(ctx->data, struct ocdb_logger_data);
+	if (!priv_data || !priv_data->profiling) return;
+
+	_ocdb_logger_dump(priv_data);
+}
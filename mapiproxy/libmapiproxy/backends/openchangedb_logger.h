@@ -24,10 +24,25 @@
 
 #include "openchangedb_backends.h"
 
+struct openchangedb_logger_stats {
+	uint64_t	count;
+	uint64_t	total_usec;
+	uint64_t	max_usec;
+};
+
 enum MAPISTATUS openchangedb_logger_initialize(TALLOC_CTX *mem_ctx,
 					       int log_level,
 					       const char *log_prefix,
 					       struct openchangedb_context *backend,
 					       struct openchangedb_context **ctx);
+enum MAPISTATUS openchangedb_logger_set_profiling(struct openchangedb_context *ctx,
+						  uint32_t dump_interval,
+						  uint32_t top,
+						  const char *trace_path);
+enum MAPISTATUS openchangedb_logger_get_stats(struct openchangedb_context *ctx,
+					      const char *function,
+					      const char *username,
+					      struct openchangedb_logger_stats *stats);
+void openchangedb_logger_dump_profile(struct openchangedb_context *ctx);
 
 #endif /* __OPENCHANGEDB_LOGGER_H__ */
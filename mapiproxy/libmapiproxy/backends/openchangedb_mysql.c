@@ -37,6 +37,19 @@
 
 #define THRESHOLD_SLOW_QUERIES 0.25
 
+/* Identifiers of the prepared statements used by the hot getters */
+enum openchangedb_mysql_stmt {
+	STMT_GET_MAPISTORE_URI = 0,
+	STMT_GET_FID,
+	STMT_GET_MAILBOX_IDS_BY_NAME,
+	STMT_GET_SERVER_CHANGE_NUMBER,
+	STMT_RESERVE_CHANGE_NUMBERS,
+	STMT_LAST_INSERT_ID,
+	STMT_GET_PUBLIC_FOLDER_PROPERTY,
+	STMT_GET_MAILBOX_PROPERTY,
+	STMT_GET_SYSTEM_FOLDER_PROPERTY
+};
+
 
 static enum MAPISTATUS _not_implemented(const char *caller) {
 	OC_DEBUG(0, "Called not implemented function `%s` from mysql backend", caller);
@@ -53,6 +66,9 @@ static enum MAPISTATUS status(enum MYSQLRESULT ret) {
 	}
 };
 
+/* Number of rows of a table fetched at once */
+static uint32_t table_page_size = OPENCHANGEDB_TABLE_PAGE_SIZE;
+
 /* forward declaration */
 static enum MAPISTATUS transaction_start(struct openchangedb_context *self);
 static enum MAPISTATUS transaction_rollback(struct openchangedb_context *self);
@@ -292,32 +308,26 @@ static enum MAPISTATUS get_mapistoreURI(TALLOC_CTX *parent_ctx,
 				        const char *username, uint64_t fid,
 				        char **mapistoreURL, bool mailboxstore)
 {
-	TALLOC_CTX	*mem_ctx;
 	MYSQL		*conn;
-	enum MAPISTATUS	retval;
-	char		*sql;
+	MYSQL_BIND	params[2];
+	unsigned long	username_len;
 
-	mem_ctx = talloc_named(NULL, 0, "get_mapistoreURI");
-	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 	conn = self->data;
-	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
 
 	if (!mailboxstore) {
-		talloc_free(mem_ctx);
 		// TODO is it possible?
 		return _not_implemented("get_mapistoreURI with mailboxstore=false");
 	}
 
-	sql = talloc_asprintf(mem_ctx,
-		"SELECT MAPIStoreURI FROM folders f "
-		"JOIN mailboxes m ON m.id = f.mailbox_id AND m.name = '%s' "
-		"WHERE f.folder_id = %"PRIu64, _sql(mem_ctx, username), fid);
-	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-
-	retval = status(select_first_string(parent_ctx, conn, sql, (const char **)mapistoreURL));
+	stmt_bind_string(&params[0], username, &username_len);
+	stmt_bind_uint64(&params[1], &fid);
 
-	talloc_free(mem_ctx);
-	return retval;
+	return status(stmt_select_first_string(parent_ctx, conn, STMT_GET_MAPISTORE_URI,
+		"SELECT MAPIStoreURI FROM folders f "
+		"JOIN mailboxes m ON m.id = f.mailbox_id AND m.name = ? "
+		"WHERE f.folder_id = ?", params, (const char **)mapistoreURL));
 }
 
 static enum MAPISTATUS get_fid(struct openchangedb_context *self,
@@ -326,7 +336,11 @@ static enum MAPISTATUS get_fid(struct openchangedb_context *self,
 	TALLOC_CTX	*mem_ctx;
 	MYSQL		*conn;
 	enum MAPISTATUS	retval;
-	char		*sql, *mapistore_uri_2;
+	char		*mapistore_uri_2;
+	MYSQL_BIND	params[2];
+	unsigned long	uri_len, uri_2_len;
+
+	OPENCHANGE_RETVAL_IF(!mapistore_uri || !mapistore_uri[0], MAPI_E_INVALID_PARAMETER, NULL);
 
 	mem_ctx = talloc_named(NULL, 0, "get_fid");
 	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
@@ -342,13 +356,12 @@ static enum MAPISTATUS get_fid(struct openchangedb_context *self,
 		OPENCHANGE_RETVAL_IF(!mapistore_uri_2, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
 	}
 
-	sql = talloc_asprintf(mem_ctx,
-		"SELECT folder_id FROM folders "
-		"WHERE MAPIStoreURI = '%s' OR MAPIStoreURI = '%s'",
-		_sql(mem_ctx, mapistore_uri), _sql(mem_ctx, mapistore_uri_2));
-	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	stmt_bind_string(&params[0], mapistore_uri, &uri_len);
+	stmt_bind_string(&params[1], mapistore_uri_2, &uri_2_len);
 
-	retval = status(select_first_uint(conn, sql, fidp));
+	retval = status(stmt_select_first_uints(conn, STMT_GET_FID,
+		"SELECT folder_id FROM folders "
+		"WHERE MAPIStoreURI = ? OR MAPIStoreURI = ?", params, 1, fidp));
 
 	talloc_free(mem_ctx);
 	return retval;
@@ -655,56 +668,30 @@ static enum MAPISTATUS get_mailbox_ids_by_name(MYSQL *conn,
 					       uint64_t *mailbox_folder_id,
 					       uint64_t *ou_id)
 {
-	TALLOC_CTX	*mem_ctx;
 	enum MAPISTATUS	retval;
-	char		*sql;
-	MYSQL_RES	*res;
-	MYSQL_ROW	row;
+	MYSQL_BIND	params[1];
+	unsigned long	username_len;
+	uint64_t	ids[3];
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
 
-	mem_ctx = talloc_named(NULL, 0, "get_mailbox_ids_by_name");
-	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	stmt_bind_string(&params[0], username, &username_len);
 
-	sql = talloc_asprintf(mem_ctx,
+	retval = status(stmt_select_first_uints(conn, STMT_GET_MAILBOX_IDS_BY_NAME,
 		"SELECT m.id, m.folder_id, m.ou_id FROM mailboxes m "
-		"WHERE m.name = '%s'", _sql(mem_ctx, username));
-	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-
-	retval = status(select_without_fetch(conn, sql, &res));
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
-	row = mysql_fetch_row(res);
-	if (row == NULL) {
-		OC_DEBUG(0, "Error getting user's mailbox `%s`: %s", sql,
-			  mysql_error(conn));
-		retval = MAPI_E_NOT_FOUND;
-		goto end;
+		"WHERE m.name = ?", params, 3, ids));
+	if (retval == MAPI_E_NOT_FOUND) {
+		OC_DEBUG(0, "Error getting user's mailbox `%s`", username);
 	}
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
 
-	if (mailbox_id) {
-		if (!convert_string_to_ull(row[0], mailbox_id)) {
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-	}
-	if (mailbox_folder_id) {
-		if (!convert_string_to_ull(row[1], mailbox_folder_id)) {
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-	}
-	if (ou_id) {
-		if (!convert_string_to_ull(row[2], ou_id)) {
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-	}
-end:
-	mysql_free_result(res);
-	talloc_free(mem_ctx);
-	return retval;
+	if (mailbox_id) *mailbox_id = ids[0];
+	if (mailbox_folder_id) *mailbox_folder_id = ids[1];
+	if (ou_id) *ou_id = ids[2];
+
+	return MAPI_E_SUCCESS;
 }
 
 #define is_public_folder(id) is_public_folder_id(NULL, id)
@@ -769,67 +756,345 @@ static enum MAPISTATUS get_folder_count(struct openchangedb_context *self,
 	return retval;
 }
 
-static enum MAPISTATUS lookup_folder_property(struct openchangedb_context *self,
-					      uint32_t proptag, uint64_t fid)
+static char *folder_ids_sql(TALLOC_CTX *mem_ctx, uint32_t count, const uint64_t *fids)
 {
-	return not_implemented();
+	char		*sql;
+	uint32_t	i;
+
+	sql = talloc_asprintf(mem_ctx, "%"PRIu64, fids[0]);
+	for (i = 1; sql && i < count; i++) {
+		sql = talloc_asprintf_append(sql, ",%"PRIu64, fids[i]);
+	}
+	return sql;
 }
 
-/**
-   \details Get the current change number field
- */
-static enum MAPISTATUS get_server_change_number(MYSQL *conn,
-						const char *username,
-						uint64_t *change_number)
+static enum MAPISTATUS get_recursive_folder_count(struct openchangedb_context *self,
+						  const char *username, uint64_t fid,
+						  uint32_t *RowCount)
 {
 	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
 	enum MAPISTATUS	retval;
 	char		*sql;
+	uint64_t	count = 0;
 
-	/* Sanity checks */
-	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
-	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
-	OPENCHANGE_RETVAL_IF(!change_number, MAPI_E_INVALID_PARAMETER, NULL);
+	mem_ctx = talloc_named(NULL, 0, "get_recursive_folder_count");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
 
-	mem_ctx = talloc_named(NULL, 0, "get_server_change_number");
+	sql = talloc_asprintf(mem_ctx,
+		"SELECT fc.recursive_count FROM folder_counts fc "
+		"JOIN mailboxes m ON m.id = fc.mailbox_id"
+		"  AND m.name = '%s' "
+		"WHERE fc.folder_id = %"PRIu64,
+		_sql(mem_ctx, username), fid);
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(select_first_uint(conn, sql, &count));
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+	*RowCount = count;
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS set_recursive_folder_count(struct openchangedb_context *self,
+						  const char *username, uint64_t fid,
+						  uint32_t RowCount)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "set_recursive_folder_count");
 	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
 
 	sql = talloc_asprintf(mem_ctx,
-		"SELECT change_number FROM servers s "
-		"JOIN mailboxes m ON m.ou_id = s.ou_id AND m.name = '%s'",
+		"INSERT INTO folder_counts (mailbox_id, folder_id, recursive_count) "
+		"SELECT m.id, %"PRIu64", %u FROM mailboxes m "
+		"WHERE m.name = '%s' "
+		"ON DUPLICATE KEY UPDATE recursive_count = VALUES(recursive_count)",
+		fid, RowCount, _sql(mem_ctx, username));
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(execute_query(conn, sql));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS update_recursive_folder_counts(struct openchangedb_context *self,
+						      const char *username, uint32_t count,
+						      const uint64_t *fids, int32_t delta)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "update_recursive_folder_counts");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	/* A single statement, the ancestors move together */
+	sql = talloc_asprintf(mem_ctx,
+		"UPDATE folder_counts fc "
+		"JOIN mailboxes m ON m.id = fc.mailbox_id"
+		"  AND m.name = '%s' "
+		"SET fc.recursive_count = GREATEST(CAST(fc.recursive_count AS SIGNED) + (%d), 0) "
+		"WHERE fc.folder_id IN (%s)",
+		_sql(mem_ctx, username), delta, folder_ids_sql(mem_ctx, count, fids));
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(execute_query(conn, sql));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS clear_recursive_folder_counts(struct openchangedb_context *self,
+						     const char *username, uint32_t count,
+						     const uint64_t *fids)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "clear_recursive_folder_counts");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	sql = talloc_asprintf(mem_ctx,
+		"DELETE fc FROM folder_counts fc "
+		"JOIN mailboxes m ON m.id = fc.mailbox_id"
+		"  AND m.name = '%s'",
 		_sql(mem_ctx, username));
+	if (sql && count) {
+		sql = talloc_asprintf_append(sql, " WHERE fc.folder_id IN (%s)",
+					     folder_ids_sql(mem_ctx, count, fids));
+	}
 	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
 
-	retval = status(select_first_uint(conn, sql, change_number));
+	retval = status(execute_query(conn, sql));
 
 	talloc_free(mem_ctx);
 	return retval;
 }
 
-/**
-   \details Set the current change number field
- */
-static enum MAPISTATUS set_server_change_number(MYSQL *conn,
-						const char *username,
-						uint64_t change_number)
+static enum MAPISTATUS get_hierarchy_change_number(struct openchangedb_context *self,
+						   const char *username, uint64_t fid,
+						   uint64_t *cn)
 {
 	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
 	enum MAPISTATUS	retval;
 	char		*sql;
 
-	/* Sanity checks */
-	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
-	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
-	OPENCHANGE_RETVAL_IF(!change_number, MAPI_E_INVALID_PARAMETER, NULL);
+	mem_ctx = talloc_named(NULL, 0, "get_hierarchy_change_number");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
 
-	mem_ctx = talloc_named(NULL, 0, "set_server_change_number");
+	sql = talloc_asprintf(mem_ctx,
+		"SELECT fcn.change_number FROM folder_change_numbers fcn "
+		"JOIN mailboxes m ON m.id = fcn.mailbox_id"
+		"  AND m.name = '%s' "
+		"WHERE fcn.folder_id = %"PRIu64,
+		_sql(mem_ctx, username), fid);
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(select_first_uint(conn, sql, cn));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS set_hierarchy_change_numbers(struct openchangedb_context *self,
+						    const char *username, uint32_t count,
+						    const uint64_t *fids, uint64_t cn)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+	uint32_t	i;
+
+	mem_ctx = talloc_named(NULL, 0, "set_hierarchy_change_numbers");
 	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
 
+	/* Change numbers only grow, a late writer never lowers them */
 	sql = talloc_asprintf(mem_ctx,
-		"UPDATE servers s "
-		"JOIN mailboxes m ON m.ou_id = s.ou_id AND m.name = '%s' "
-		"SET s.change_number=%"PRIu64,
-		_sql(mem_ctx, username), change_number);
+		"INSERT INTO folder_change_numbers (mailbox_id, folder_id, change_number) "
+		"SELECT m.id, f.folder_id, %"PRIu64" FROM mailboxes m "
+		"JOIN (SELECT %"PRIu64" AS folder_id",
+		cn, fids[0]);
+	for (i = 1; sql && i < count; i++) {
+		sql = talloc_asprintf_append(sql, " UNION ALL SELECT %"PRIu64, fids[i]);
+	}
+	if (sql) {
+		sql = talloc_asprintf_append(sql,
+			") f "
+			"WHERE m.name = '%s' "
+			"ON DUPLICATE KEY UPDATE change_number = GREATEST(change_number, VALUES(change_number))",
+			_sql(mem_ctx, username));
+	}
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(execute_query(conn, sql));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS clear_hierarchy_change_numbers(struct openchangedb_context *self,
+						      const char *username, uint32_t count,
+						      const uint64_t *fids)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "clear_hierarchy_change_numbers");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	sql = talloc_asprintf(mem_ctx,
+		"DELETE fcn FROM folder_change_numbers fcn "
+		"JOIN mailboxes m ON m.id = fcn.mailbox_id"
+		"  AND m.name = '%s'",
+		_sql(mem_ctx, username));
+	if (sql && count) {
+		sql = talloc_asprintf_append(sql, " WHERE fcn.folder_id IN (%s)",
+					     folder_ids_sql(mem_ctx, count, fids));
+	}
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(execute_query(conn, sql));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS get_message_counts(struct openchangedb_context *self,
+					  const char *username, uint64_t fid,
+					  uint32_t max_age,
+					  struct openchangedb_message_counts *counts)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	MYSQL_RES	*res;
+	MYSQL_ROW	row;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "get_message_counts");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	sql = talloc_asprintf(mem_ctx,
+		"SELECT fmc.messages, fmc.fai, fmc.unread, fmc.size "
+		"FROM folder_message_counts fmc "
+		"JOIN mailboxes m ON m.id = fmc.mailbox_id"
+		"  AND m.name = '%s' "
+		"WHERE fmc.folder_id = %"PRIu64,
+		_sql(mem_ctx, username), fid);
+	if (sql && max_age) {
+		sql = talloc_asprintf_append(sql,
+			" AND fmc.refreshed > NOW() - INTERVAL %u SECOND", max_age);
+	}
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(select_without_fetch(conn, sql, &res));
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+
+	row = mysql_fetch_row(res);
+	if (row == NULL || !row[0] || !row[1] || !row[2] || !row[3]) {
+		OC_DEBUG(0, "Error getting row of `%s`: %s", sql, mysql_error(conn));
+		mysql_free_result(res);
+		talloc_free(mem_ctx);
+		return MAPI_E_CALL_FAILED;
+	}
+	counts->messages = strtoll(row[0], NULL, 10);
+	counts->fai = strtoll(row[1], NULL, 10);
+	counts->unread = strtoll(row[2], NULL, 10);
+	counts->size = strtoll(row[3], NULL, 10);
+	mysql_free_result(res);
+
+	talloc_free(mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+static enum MAPISTATUS set_message_counts(struct openchangedb_context *self,
+					  const char *username, uint64_t fid,
+					  const struct openchangedb_message_counts *counts)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "set_message_counts");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	sql = talloc_asprintf(mem_ctx,
+		"INSERT INTO folder_message_counts "
+		"(mailbox_id, folder_id, messages, fai, unread, size, refreshed) "
+		"SELECT m.id, %"PRIu64", %"PRId64", %"PRId64", %"PRId64", %"PRId64", NOW() "
+		"FROM mailboxes m "
+		"WHERE m.name = '%s' "
+		"ON DUPLICATE KEY UPDATE messages = VALUES(messages), fai = VALUES(fai),"
+		" unread = VALUES(unread), size = VALUES(size), refreshed = VALUES(refreshed)",
+		fid, counts->messages, counts->fai, counts->unread, counts->size,
+		_sql(mem_ctx, username));
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(execute_query(conn, sql));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS update_message_counts(struct openchangedb_context *self,
+					     const char *username, uint64_t fid,
+					     const struct openchangedb_message_counts *delta)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "update_message_counts");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	/* A folder without counters stays without, the next lookup
+	 * counts its messages */
+	sql = talloc_asprintf(mem_ctx,
+		"UPDATE folder_message_counts fmc "
+		"JOIN mailboxes m ON m.id = fmc.mailbox_id"
+		"  AND m.name = '%s' "
+		"SET fmc.messages = GREATEST(fmc.messages + (%"PRId64"), 0),"
+		" fmc.fai = GREATEST(fmc.fai + (%"PRId64"), 0),"
+		" fmc.unread = GREATEST(fmc.unread + (%"PRId64"), 0),"
+		" fmc.size = GREATEST(fmc.size + (%"PRId64"), 0) "
+		"WHERE fmc.folder_id = %"PRIu64,
+		_sql(mem_ctx, username), delta->messages, delta->fai, delta->unread,
+		delta->size, fid);
 	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
 
 	retval = status(execute_query(conn, sql));
@@ -838,6 +1103,114 @@ static enum MAPISTATUS set_server_change_number(MYSQL *conn,
 	return retval;
 }
 
+static enum MAPISTATUS clear_message_counts(struct openchangedb_context *self,
+					    const char *username, uint32_t count,
+					    const uint64_t *fids)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	enum MAPISTATUS	retval;
+	char		*sql;
+
+	mem_ctx = talloc_named(NULL, 0, "clear_message_counts");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	sql = talloc_asprintf(mem_ctx,
+		"DELETE fmc FROM folder_message_counts fmc "
+		"JOIN mailboxes m ON m.id = fmc.mailbox_id"
+		"  AND m.name = '%s'",
+		_sql(mem_ctx, username));
+	if (sql && count) {
+		sql = talloc_asprintf_append(sql, " WHERE fmc.folder_id IN (%s)",
+					     folder_ids_sql(mem_ctx, count, fids));
+	}
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(execute_query(conn, sql));
+
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static enum MAPISTATUS lookup_folder_property(struct openchangedb_context *self,
+					      uint32_t proptag, uint64_t fid)
+{
+	return not_implemented();
+}
+
+/**
+   \details Get the current change number field
+ */
+static enum MAPISTATUS get_server_change_number(MYSQL *conn,
+						const char *username,
+						uint64_t *change_number)
+{
+	MYSQL_BIND	params[1];
+	unsigned long	username_len;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!change_number, MAPI_E_INVALID_PARAMETER, NULL);
+
+	stmt_bind_string(&params[0], username, &username_len);
+
+	return status(stmt_select_first_uints(conn, STMT_GET_SERVER_CHANGE_NUMBER,
+		"SELECT change_number FROM servers s "
+		"JOIN mailboxes m ON m.ou_id = s.ou_id AND m.name = ?",
+		params, 1, change_number));
+}
+
+/**
+   \details Atomically reserve a range of change numbers on the server
+
+   \param conn pointer to the MySQL connection
+   \param username the mailbox owner
+   \param count the number of change numbers to reserve
+   \param first pointer to the first reserved (raw) change number
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS reserve_server_change_numbers(MYSQL *conn,
+						     const char *username,
+						     uint64_t count,
+						     uint64_t *first)
+{
+	enum MAPISTATUS	retval;
+	MYSQL_BIND	params[2];
+	unsigned long	username_len;
+	uint64_t	affected = 0;
+	uint64_t	last;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!count, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!first, MAPI_E_INVALID_PARAMETER, NULL);
+
+	/* LAST_INSERT_ID(expr) makes the updated value available to
+	   this connection only, the increment is a single statement
+	   so there is no need for an explicit transaction */
+	stmt_bind_string(&params[0], username, &username_len);
+	stmt_bind_uint64(&params[1], &count);
+	retval = status(stmt_execute(conn, STMT_RESERVE_CHANGE_NUMBERS,
+		"UPDATE servers s "
+		"JOIN mailboxes m ON m.ou_id = s.ou_id AND m.name = ? "
+		"SET s.change_number = LAST_INSERT_ID(s.change_number + ?)",
+		params, &affected));
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
+	OPENCHANGE_RETVAL_IF(affected == 0, MAPI_E_NOT_FOUND, NULL);
+
+	retval = status(stmt_select_first_uints(conn, STMT_LAST_INSERT_ID,
+						"SELECT LAST_INSERT_ID()", NULL, 1, &last));
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
+
+	*first = last - count;
+	return MAPI_E_SUCCESS;
+}
+
 static enum MAPISTATUS get_new_changeNumber(struct openchangedb_context *self,
 					    const char *username,
 					    uint64_t *cn)
@@ -847,11 +1220,9 @@ static enum MAPISTATUS get_new_changeNumber(struct openchangedb_context *self,
 
 	conn = self->data;
 	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, NULL);
+	OPENCHANGE_RETVAL_IF(!cn, MAPI_E_INVALID_PARAMETER, NULL);
 
-	retval = get_server_change_number(conn, username, cn);
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
-
-	retval = set_server_change_number(conn, username, (*cn) + 1);
+	retval = reserve_server_change_numbers(conn, username, 1, cn);
 	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
 
 	// Transform the number the way exchange protocol likes it
@@ -874,22 +1245,22 @@ static enum MAPISTATUS get_new_changeNumbers(struct openchangedb_context *self,
 
 	conn = self->data;
 	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, NULL);
+	OPENCHANGE_RETVAL_IF(!cns_p, MAPI_E_INVALID_PARAMETER, NULL);
 
-	retval = get_server_change_number(conn, username, &cn);
+	retval = reserve_server_change_numbers(conn, username, max, &cn);
 	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
 
 	// Transform the numbers the way exchange protocol likes it
 	cns = talloc_zero(mem_ctx, struct UI8Array_r);
+	OPENCHANGE_RETVAL_IF(!cns, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 	cns->cValues = max;
 	cns->lpui8 = talloc_array(cns, uint64_t, max);
+	OPENCHANGE_RETVAL_IF(!cns->lpui8, MAPI_E_NOT_ENOUGH_MEMORY, cns);
 
 	for (count = 0; count < max; count++) {
 		cns->lpui8[count] = (exchange_globcnt(cn + count) << 16) | 0x0001;
 	}
 
-	retval = set_server_change_number(conn, username, cn + max);
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
-
 	*cns_p = cns;
 
 	return retval;
@@ -898,19 +1269,23 @@ static enum MAPISTATUS get_new_changeNumbers(struct openchangedb_context *self,
 static enum MAPISTATUS get_next_changeNumber(struct openchangedb_context *self,
 					     const char *username, uint64_t *cn)
 {
-	MYSQL		*conn;
-	enum MAPISTATUS	retval;
+	MYSQL			*conn;
+	enum MAPISTATUS		retval;
 
 	conn = self->data;
 	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!cn, MAPI_E_INVALID_PARAMETER, NULL);
 
+	/* Change numbers are only allocated on the server, so this is
+	   the next one whatever the process allocating it */
 	retval = get_server_change_number(conn, username, cn);
 	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
 
 	// Transform the number the way exchange protocol likes it
 	*cn = (exchange_globcnt(*cn) << 16) | 0x0001;
 
-	return retval;
+	return MAPI_E_SUCCESS;
 }
 
 static char *_unknown_property(TALLOC_CTX *mem_ctx, uint32_t proptag)
@@ -1115,106 +1490,426 @@ static enum MAPISTATUS get_folder_property(TALLOC_CTX *parent_ctx,
 	TALLOC_CTX	*mem_ctx;
 	MYSQL		*conn;
 	enum MAPISTATUS	retval = MAPI_E_SUCCESS;
-	char		*sql = NULL;
 	uint64_t	mailbox_id = 0, mailbox_folder_id = 0;
-	uint64_t	*n = NULL;
-	const char	*attr, *value;
+	uint64_t	*n = NULL;
+	const char	*attr, *value;
+	MYSQL_BIND	params[3];
+	unsigned long	username_len, attr_len;
+
+	mem_ctx = talloc_named(NULL, 0, "get_folder_property");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	attr = openchangedb_property_get_attribute(proptag);
+	if (!attr) {
+		attr = _unknown_property(parent_ctx, proptag);
+	}
+
+	*data = _get_special_property(parent_ctx, proptag);
+	if (*data != NULL) goto end;
+
+	if (proptag == PidTagFolderId) {
+		n = talloc_zero(parent_ctx, uint64_t);
+		OPENCHANGE_RETVAL_IF(!n, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+		*n = fid;
+		*data = (void *) n;
+		goto end;
+	}
+
+	if (is_public_folder(fid)) {
+		if (proptag == PidTagParentFolderId) {
+			n = talloc_zero(parent_ctx, uint64_t);
+			OPENCHANGE_RETVAL_IF(!n, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+			retval = get_parent_fid(self, username, fid, n, true);
+			OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+			*data = (void *) n;
+			goto end;
+		}
+
+		stmt_bind_uint64(&params[0], &fid);
+		stmt_bind_string(&params[1], username, &username_len);
+		stmt_bind_string(&params[2], attr, &attr_len);
+		retval = status(stmt_select_first_string(mem_ctx, conn,
+			STMT_GET_PUBLIC_FOLDER_PROPERTY,
+			"SELECT fp.value FROM folders_properties fp "
+			"JOIN folders f ON f.id = fp.folder_id "
+			"  AND f.folder_class = '"PUBLIC_FOLDER"'"
+			"  AND f.folder_id = ? "
+			"JOIN mailboxes m ON m.ou_id = f.ou_id"
+			"  AND m.name = ? "
+			"WHERE fp.name = ?", params, &value));
+	} else {
+		// system folder
+		retval = get_mailbox_ids_by_name(conn, username, &mailbox_id, &mailbox_folder_id, NULL);
+		OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+
+		if (mailbox_folder_id == fid) {
+			stmt_bind_uint64(&params[0], &mailbox_id);
+			stmt_bind_string(&params[1], attr, &attr_len);
+			retval = status(stmt_select_first_string(mem_ctx, conn,
+				STMT_GET_MAILBOX_PROPERTY,
+				"SELECT mp.value FROM mailboxes_properties mp "
+				"WHERE mp.mailbox_id = ? AND mp.name = ?",
+				params, &value));
+		} else if (proptag == PidTagParentFolderId) {
+			n = talloc_zero(parent_ctx, uint64_t);
+			OPENCHANGE_RETVAL_IF(!n, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+			retval = get_parent_fid(self, username, fid, n, true);
+			OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+			*data = (void *) n;
+			goto end;
+		} else {
+			stmt_bind_uint64(&params[0], &mailbox_id);
+			stmt_bind_uint64(&params[1], &fid);
+			stmt_bind_string(&params[2], attr, &attr_len);
+			retval = status(stmt_select_first_string(mem_ctx, conn,
+				STMT_GET_SYSTEM_FOLDER_PROPERTY,
+				"SELECT fp.value FROM folders_properties fp "
+				"JOIN folders f ON f.id = fp.folder_id "
+				"  AND f.mailbox_id = ? "
+				"  AND f.folder_id = ? "
+				"WHERE fp.name = ?", params, &value));
+		}
+	}
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+	// Transform string into the expected data type
+	*data = get_property_data(parent_ctx, proptag, value);
+end:
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+static char *str_list_join_for_sql(TALLOC_CTX *mem_ctx, const char **list)
+{
+	char	*ret = NULL;
+	int	i = 0;
+
+	if (list[0] == NULL) {
+		return talloc_strdup(mem_ctx, "");
+	}
+
+	ret = talloc_asprintf(mem_ctx, "'%s'", _sql(mem_ctx, list[0]));
+	if (!ret) return NULL;
+
+	for (i = 1; list[i]; i++) {
+		ret = talloc_asprintf_append_buffer(ret, ",'%s'", _sql(mem_ctx, list[i]));
+		if (!ret) return NULL;
+	}
+
+	return ret;
+}
+
+static enum MAPISTATUS get_folder_properties(TALLOC_CTX *parent_ctx,
+					     struct openchangedb_context *self,
+					     const char *username,
+					     struct SPropTagArray *properties,
+					     uint64_t fid, void **data,
+					     enum MAPISTATUS *retvals)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn;
+	MYSQL_RES	*res;
+	MYSQL_ROW	row;
+	enum MAPISTATUS	retval;
+	uint64_t	mailbox_id = 0, mailbox_folder_id = 0;
+	uint32_t	i, proptag, count = 0;
+	const char	**attrs, **names;
+	char		*names_for_sql, *sql;
 
-	mem_ctx = talloc_named(NULL, 0, "get_folder_property");
+	mem_ctx = talloc_named(NULL, 0, "get_folder_properties");
 	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 	conn = self->data;
 	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
 
-	attr = openchangedb_property_get_attribute(proptag);
-	if (!attr) {
-		attr = _unknown_property(parent_ctx, proptag);
-	}
-
-	*data = _get_special_property(parent_ctx, proptag);
-	if (*data != NULL) goto end;
+	attrs = talloc_zero_array(mem_ctx, const char *, properties->cValues);
+	names = talloc_zero_array(mem_ctx, const char *, properties->cValues + 1);
+	OPENCHANGE_RETVAL_IF(!attrs || !names, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	/* Step 1. Resolve the properties which don't need a lookup, the
+	 * others are fetched by a single query */
+	for (i = 0; i < properties->cValues; i++) {
+		proptag = properties->aulPropTag[i];
+		data[i] = _get_special_property(parent_ctx, proptag);
+		if (data[i] != NULL) {
+			retvals[i] = MAPI_E_SUCCESS;
+			continue;
+		}
+		if (proptag == PidTagFolderId || proptag == PidTagParentFolderId) {
+			retvals[i] = get_folder_property(parent_ctx, self, username, proptag, fid, data + i);
+			continue;
+		}
 
-	if (proptag == PidTagFolderId) {
-		n = talloc_zero(parent_ctx, uint64_t);
-		OPENCHANGE_RETVAL_IF(!n, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-		*n = fid;
-		*data = (void *) n;
-		goto end;
+		retvals[i] = MAPI_E_NOT_FOUND;
+		attrs[i] = openchangedb_property_get_attribute(proptag);
+		if (!attrs[i]) {
+			attrs[i] = _unknown_property(mem_ctx, proptag);
+			OPENCHANGE_RETVAL_IF(!attrs[i], MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+		}
+		names[count++] = attrs[i];
 	}
+	OPENCHANGE_RETVAL_IF(!count, MAPI_E_SUCCESS, mem_ctx);
 
-	if (is_public_folder(fid)) {
-		if (proptag == PidTagParentFolderId) {
-			n = talloc_zero(parent_ctx, uint64_t);
-			OPENCHANGE_RETVAL_IF(!n, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-			retval = get_parent_fid(self, username, fid, n, true);
-			OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
-			*data = (void *) n;
-			goto end;
-		}
+	names_for_sql = str_list_join_for_sql(mem_ctx, names);
+	OPENCHANGE_RETVAL_IF(!names_for_sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
 
+	/* Step 2. Fetch them from the record holding the folder */
+	if (is_public_folder(fid)) {
 		sql = talloc_asprintf(mem_ctx,
-			"SELECT fp.value FROM folders_properties fp "
+			"SELECT fp.name, fp.value FROM folders_properties fp "
 			"JOIN folders f ON f.id = fp.folder_id "
 			"  AND f.folder_class = '"PUBLIC_FOLDER"'"
 			"  AND f.folder_id = %"PRIu64" "
 			"JOIN mailboxes m ON m.ou_id = f.ou_id"
 			"  AND m.name = '%s' "
-			"WHERE fp.name = '%s'",
-			fid, _sql(mem_ctx, username), _sql(mem_ctx, attr));
+			"WHERE fp.name IN (%s)",
+			fid, _sql(mem_ctx, username), names_for_sql);
 	} else {
-		// system folder
 		retval = get_mailbox_ids_by_name(conn, username, &mailbox_id, &mailbox_folder_id, NULL);
 		OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
 
 		if (mailbox_folder_id == fid) {
 			sql = talloc_asprintf(mem_ctx,
-				"SELECT mp.value FROM mailboxes_properties mp "
-				"WHERE mp.mailbox_id = %"PRIu64" AND mp.name = '%s'",
-				mailbox_id, _sql(mem_ctx, attr));
-		} else if (proptag == PidTagParentFolderId) {
-			n = talloc_zero(parent_ctx, uint64_t);
-			OPENCHANGE_RETVAL_IF(!n, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-			retval = get_parent_fid(self, username, fid, n, true);
-			OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
-			*data = (void *) n;
-			goto end;
+				"SELECT mp.name, mp.value FROM mailboxes_properties mp "
+				"WHERE mp.mailbox_id = %"PRIu64" AND mp.name IN (%s)",
+				mailbox_id, names_for_sql);
 		} else {
 			sql = talloc_asprintf(mem_ctx,
-				"SELECT fp.value FROM folders_properties fp "
+				"SELECT fp.name, fp.value FROM folders_properties fp "
 				"JOIN folders f ON f.id = fp.folder_id "
 				"  AND f.mailbox_id = %"PRIu64" "
 				"  AND f.folder_id = %"PRIu64" "
-				"WHERE fp.name = '%s'",
-				mailbox_id, fid, _sql(mem_ctx, attr));
+				"WHERE fp.name IN (%s)",
+				mailbox_id, fid, names_for_sql);
 		}
 	}
 	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	retval = status(select_first_string(mem_ctx, conn, sql, &value));
+
+	retval = status(select_without_fetch(conn, sql, &res));
+	OPENCHANGE_RETVAL_IF(retval == MAPI_E_NOT_FOUND, MAPI_E_SUCCESS, mem_ctx);
 	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
-	// Transform string into the expected data type
-	*data = get_property_data(parent_ctx, proptag, value);
-end:
+
+	/* Step 3. Transform strings into the expected data types */
+	while ((row = mysql_fetch_row(res)) != NULL) {
+		if (!row[0] || !row[1]) continue;
+		for (i = 0; i < properties->cValues; i++) {
+			if (attrs[i] && retvals[i] != MAPI_E_SUCCESS && !strcmp(attrs[i], row[0])) {
+				data[i] = get_property_data(parent_ctx, properties->aulPropTag[i], row[1]);
+				retvals[i] = MAPI_E_SUCCESS;
+			}
+		}
+	}
+	mysql_free_result(res);
+
 	talloc_free(mem_ctx);
-	return retval;
+	return MAPI_E_SUCCESS;
 }
 
-static char *str_list_join_for_sql(TALLOC_CTX *mem_ctx, const char **list)
+/* A folder of the tree read by get_folder_tree() */
+struct folder_tree_node {
+	uint64_t	id;
+	uint64_t	fid;
+	uint64_t	parent_id;	/* 0 for the folders without parent */
+	bool		mapistore;
+	void		**data;
+	enum MAPISTATUS	*retvals;
+};
+
+struct folder_tree_walk {
+	struct folder_tree_node			*nodes;
+	uint32_t				node_count;
+	uint32_t				max_depth;
+	struct SPropTagArray			*properties;
+	struct openchangedb_folder_tree_entry	*entries;
+	uint32_t				count;
+};
+
+/* Nodes are sorted by parent: the children of a folder are contiguous */
+static uint32_t _folder_tree_first_child(struct folder_tree_walk *walk, uint64_t parent_id)
 {
-	char	*ret = NULL;
-	int	i = 0;
+	uint32_t	low = 0, high = walk->node_count, middle;
 
-	if (list[0] == NULL) {
-		return talloc_strdup(mem_ctx, "");
+	while (low < high) {
+		middle = (low + high) / 2;
+		if (walk->nodes[middle].parent_id < parent_id) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
 	}
+	return low;
+}
 
-	ret = talloc_asprintf(mem_ctx, "'%s'", _sql(mem_ctx, list[0]));
-	if (!ret) return NULL;
+static void _folder_tree_walk(struct folder_tree_walk *walk, uint64_t parent_id, uint64_t parent_fid, uint32_t depth)
+{
+	struct openchangedb_folder_tree_entry	*entry;
+	struct folder_tree_node			*node;
+	uint64_t				*n;
+	uint32_t				*l;
+	uint32_t				i, j;
+
+	if (walk->max_depth && depth >= walk->max_depth) return;
+
+	for (i = _folder_tree_first_child(walk, parent_id);
+	     i < walk->node_count && walk->nodes[i].parent_id == parent_id; i++) {
+		node = walk->nodes + i;
+		entry = walk->entries + walk->count++;
+		entry->fid = node->fid;
+		entry->parent_fid = parent_fid;
+		entry->depth = depth;
+		entry->mapistore = node->mapistore;
+		entry->data = talloc_steal(walk->entries, node->data);
+		entry->retvals = talloc_steal(walk->entries, node->retvals);
+
+		/* Properties known from the tree itself */
+		for (j = 0; j < walk->properties->cValues; j++) {
+			switch (walk->properties->aulPropTag[j]) {
+			case PidTagFolderId:
+			case PidTagParentFolderId:
+				n = talloc_zero(entry->data, uint64_t);
+				if (!n) break;
+				*n = (walk->properties->aulPropTag[j] == PidTagFolderId) ? node->fid : parent_fid;
+				entry->data[j] = n;
+				entry->retvals[j] = MAPI_E_SUCCESS;
+				break;
+			case PR_DEPTH:
+				l = talloc_zero(entry->data, uint32_t);
+				if (!l) break;
+				*l = depth;
+				entry->data[j] = l;
+				entry->retvals[j] = MAPI_E_SUCCESS;
+				break;
+			default:
+				break;
+			}
+		}
 
-	for (i = 1; list[i]; i++) {
-		ret = talloc_asprintf_append_buffer(ret, ",'%s'", _sql(mem_ctx, list[i]));
-		if (!ret) return NULL;
+		_folder_tree_walk(walk, node->id, node->fid, depth + 1);
 	}
+}
 
-	return ret;
+static enum MAPISTATUS get_folder_tree(TALLOC_CTX *parent_ctx,
+				       struct openchangedb_context *self,
+				       const char *username, uint64_t fid,
+				       uint32_t max_depth,
+				       struct SPropTagArray *properties,
+				       uint32_t *countp,
+				       struct openchangedb_folder_tree_entry **entriesp)
+{
+	TALLOC_CTX		*mem_ctx;
+	MYSQL			*conn;
+	MYSQL_RES		*res;
+	MYSQL_ROW		row;
+	enum MAPISTATUS		retval;
+	struct folder_tree_walk	walk;
+	struct folder_tree_node	*node = NULL;
+	uint64_t		id, root_id = 0, mailbox_id = 0, mailbox_folder_id = 0, ou_id = 0;
+	uint32_t		i, allocated, names_count = 0;
+	const char		**attrs, **names;
+	char			*names_for_sql, *scope, *sql;
+	bool			found;
+
+	mem_ctx = talloc_named(NULL, 0, "get_folder_tree");
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	conn = self->data;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_BAD_VALUE, mem_ctx);
+
+	attrs = talloc_zero_array(mem_ctx, const char *, properties->cValues);
+	names = talloc_zero_array(mem_ctx, const char *, properties->cValues + 1);
+	OPENCHANGE_RETVAL_IF(!attrs || !names, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	for (i = 0; i < properties->cValues; i++) {
+		attrs[i] = openchangedb_property_get_attribute(properties->aulPropTag[i]);
+		if (!attrs[i]) {
+			attrs[i] = _unknown_property(mem_ctx, properties->aulPropTag[i]);
+			OPENCHANGE_RETVAL_IF(!attrs[i], MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+		}
+		names[names_count++] = attrs[i];
+	}
+	names_for_sql = names_count ? str_list_join_for_sql(mem_ctx, names) : talloc_strdup(mem_ctx, "NULL");
+	OPENCHANGE_RETVAL_IF(!names_for_sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = get_mailbox_ids_by_name(conn, username, &mailbox_id, &mailbox_folder_id, &ou_id);
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+	if (is_public_folder(fid)) {
+		scope = talloc_asprintf(mem_ctx, "f.ou_id = %"PRIu64" AND f.folder_class = '"PUBLIC_FOLDER"'", ou_id);
+	} else {
+		scope = talloc_asprintf(mem_ctx, "f.mailbox_id = %"PRIu64, mailbox_id);
+	}
+	OPENCHANGE_RETVAL_IF(!scope, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	/* The whole tree with the requested properties in one query: the
+	 * rows of a folder are grouped and the children of a folder are
+	 * contiguous, NULL parents first */
+	sql = talloc_asprintf(mem_ctx,
+		"SELECT f.id, f.folder_id, f.parent_folder_id, f.MAPIStoreURI, fp.name, fp.value "
+		"FROM folders f "
+		"LEFT JOIN folders_properties fp ON fp.folder_id = f.id"
+		"  AND fp.name IN (%s) "
+		"WHERE %s "
+		"ORDER BY f.parent_folder_id, f.id",
+		names_for_sql, scope);
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	retval = status(select_without_fetch(conn, sql, &res));
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+
+	memset(&walk, 0, sizeof (struct folder_tree_walk));
+	allocated = mysql_num_rows(res);
+	walk.nodes = talloc_array(mem_ctx, struct folder_tree_node, allocated ? allocated : 1);
+	if (!walk.nodes) {
+		mysql_free_result(res);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	}
+
+	found = (!is_public_folder(fid) && fid == mailbox_folder_id);
+	while ((row = mysql_fetch_row(res)) != NULL) {
+		if (!row[0] || !convert_string_to_ull(row[0], &id)) continue;
+		if (!node || node->id != id) {
+			node = walk.nodes + walk.node_count++;
+			node->id = id;
+			node->fid = 0;
+			node->parent_id = 0;
+			if (row[1]) convert_string_to_ull(row[1], &node->fid);
+			if (row[2]) convert_string_to_ull(row[2], &node->parent_id);
+			node->mapistore = (row[3] && row[3][0]);
+			node->data = talloc_zero_array(walk.nodes, void *, properties->cValues);
+			node->retvals = talloc_array(walk.nodes, enum MAPISTATUS, properties->cValues);
+			if (!node->data || !node->retvals) {
+				mysql_free_result(res);
+				OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+			}
+			for (i = 0; i < properties->cValues; i++) {
+				node->data[i] = _get_special_property(node->data, properties->aulPropTag[i]);
+				node->retvals[i] = node->data[i] ? MAPI_E_SUCCESS : MAPI_E_NOT_FOUND;
+			}
+			if (!found && node->fid == fid) {
+				root_id = node->id;
+				found = true;
+			}
+		}
+		if (!row[4] || !row[5]) continue;
+		for (i = 0; i < properties->cValues; i++) {
+			if (node->retvals[i] != MAPI_E_SUCCESS && !strcmp(attrs[i], row[4])) {
+				node->data[i] = get_property_data(node->data, properties->aulPropTag[i], row[5]);
+				node->retvals[i] = node->data[i] ? MAPI_E_SUCCESS : MAPI_E_NOT_FOUND;
+			}
+		}
+	}
+	mysql_free_result(res);
+	OPENCHANGE_RETVAL_IF(!found, MAPI_E_NOT_FOUND, mem_ctx);
+
+	walk.max_depth = max_depth;
+	walk.properties = properties;
+	walk.entries = talloc_array(parent_ctx, struct openchangedb_folder_tree_entry,
+				    walk.node_count ? walk.node_count : 1);
+	OPENCHANGE_RETVAL_IF(!walk.entries, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	_folder_tree_walk(&walk, root_id, fid, 0);
+
+	*countp = walk.count;
+	*entriesp = walk.entries;
+
+	talloc_free(mem_ctx);
+	return MAPI_E_SUCCESS;
 }
 
 static enum MAPISTATUS set_folder_properties(struct openchangedb_context *self,
@@ -1588,6 +2283,12 @@ static enum MAPISTATUS delete_folder(struct openchangedb_context *self,
 	}
 	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
 	retval = status(execute_query(conn, sql));
+	if (retval == MAPI_E_SUCCESS && !is_public_folder(fid)) {
+		/* The ancestors of the folder are not known here */
+		clear_recursive_folder_counts(self, username, 0, NULL);
+		clear_hierarchy_change_numbers(self, username, 0, NULL);
+		clear_message_counts(self, username, 1, &fid);
+	}
 
 	talloc_free(mem_ctx);
 	return retval;
@@ -1946,6 +2647,11 @@ static enum MAPISTATUS create_folder(struct openchangedb_context *self,
 end:
 	if (retval == MAPI_E_SUCCESS) {
 		transaction_commit(self);
+		if (!is_public_folder(fid)) {
+			/* The ancestors of the folder are not known here */
+			clear_recursive_folder_counts(self, username, 0, NULL);
+			clear_hierarchy_change_numbers(self, username, 0, NULL);
+		}
 	} else {
 		transaction_rollback(self);
 	}
@@ -2287,19 +2993,39 @@ static const char **get_folders_names(TALLOC_CTX *parent_ctx,
 
 // v openchangedb table -------------------------------------------------------
 
+/* Properties of a row, loaded together with the ones of the rows
+   next to it */
+struct openchangedb_table_row_properties {
+	size_t		count;
+	const char	**names;
+	const char	**values;
+};
+
 struct openchangedb_table_message_row {
-	uint64_t	id;
-	uint64_t	mid;
-	char		*normalized_subject;
+	uint64_t					id;
+	uint64_t					mid;
+	char						*normalized_subject;
+	struct openchangedb_table_row_properties	*props;
 };
 
 struct openchangedb_table_folder_row {
-	uint64_t	id;
-	uint64_t	fid;
+	uint64_t					id;
+	uint64_t					fid;
+	struct openchangedb_table_row_properties	*props;
 };
 
+/* Rows [offset, offset + loaded) of the table are in memory, the
+   properties of rows [window_offset, window_offset + window_count) */
 struct openchangedb_table_results {
 	size_t		count;
+	char		*sql;
+	bool		paged;
+	TALLOC_CTX	*page;
+	size_t		offset;
+	size_t		loaded;
+	TALLOC_CTX	*window;
+	size_t		window_offset;
+	size_t		window_count;
 	union {
 		struct openchangedb_table_folder_row	**folders;
 		struct openchangedb_table_message_row	**messages;
@@ -2312,7 +3038,8 @@ struct openchangedb_table {
 	const char				*username;
 	uint8_t					table_type;
 	struct SSortOrderSet			*lpSortCriteria;
-	struct mapi_SRestriction		*restrictions;
+	struct mapiproxy_restriction		*restrictions;
+	bool					restrictions_in_sql;
 	struct openchangedb_table_results	*res;
 };
 
@@ -2381,7 +3108,8 @@ static enum MAPISTATUS table_set_restrictions(struct openchangedb_context *self,
 					      void *_table,
 					      struct mapi_SRestriction *res)
 {
-	struct openchangedb_table *table = (struct openchangedb_table *)_table;
+	struct openchangedb_table	*table = (struct openchangedb_table *)_table;
+	enum MAPISTATUS			retval;
 
 	if (table->res) {
 		talloc_free(table->res);
@@ -2392,578 +3120,554 @@ static enum MAPISTATUS table_set_restrictions(struct openchangedb_context *self,
 		talloc_free(table->restrictions);
 		table->restrictions = NULL;
 	}
+	table->restrictions_in_sql = false;
 
-	table->restrictions = talloc_zero(table, struct mapi_SRestriction);
-	OPENCHANGE_RETVAL_IF(!table->restrictions, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	if (!res) return MAPI_E_SUCCESS;
 
-	if (res->rt != RES_PROPERTY) {
+	retval = mapiproxy_restriction_compile(table, res, &table->restrictions);
+	if (retval != MAPI_E_SUCCESS) {
 		OC_DEBUG(5, "Unsupported restriction type: 0x%x\n", res->rt);
-		return MAPI_E_INVALID_PARAMETER;
-	}
-
-	table->restrictions->rt = res->rt;
-	table->restrictions->res.resProperty.relop = res->res.resProperty.relop;
-	table->restrictions->res.resProperty.ulPropTag = res->res.resProperty.ulPropTag;
-	table->restrictions->res.resProperty.lpProp.ulPropTag = res->res.resProperty.lpProp.ulPropTag;
-
-	switch (table->restrictions->res.resProperty.lpProp.ulPropTag & 0xFFFF) {
-	case PT_STRING8:
-		table->restrictions->res.resProperty.lpProp.value.lpszA =
-			talloc_strdup(table->restrictions, res->res.resProperty.lpProp.value.lpszA);
-		OPENCHANGE_RETVAL_IF(!table->restrictions->res.resProperty.lpProp.value.lpszA, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
-		break;
-	case PT_UNICODE:
-		table->restrictions->res.resProperty.lpProp.value.lpszW =
-			talloc_strdup(table->restrictions, res->res.resProperty.lpProp.value.lpszW);
-		OPENCHANGE_RETVAL_IF(!table->restrictions->res.resProperty.lpProp.value.lpszW, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
-		break;
-	default:
-		OC_DEBUG(0, "Unsupported property type for RES_PROPERTY restriction\n");
-		return MAPI_E_INVALID_PARAMETER;
+		return retval;
 	}
 
 	return MAPI_E_SUCCESS;
 }
 
-static enum MAPISTATUS _table_get_attr_and_value_from_restrictions(
-	TALLOC_CTX *mem_ctx, struct mapi_SRestriction *restrictions,
-	const char **attr, const char **value)
+static const char *_table_sql_relop(uint8_t relop)
 {
-	if (restrictions) {
-		*attr = openchangedb_property_get_attribute(restrictions->res.resProperty.ulPropTag);
-		switch (restrictions->res.resProperty.ulPropTag & 0xFFFF) {
-		case PT_STRING8:
-			*value = _sql(mem_ctx, restrictions->res.resProperty.lpProp.value.lpszA);
-			break;
-		case PT_UNICODE:
-			*value = _sql(mem_ctx, restrictions->res.resProperty.lpProp.value.lpszW);
-			break;
-		default:
-			OC_DEBUG(0, "Unsupported RES_PROPERTY property type: 0x%.4x\n",
-				  (restrictions->res.resProperty.ulPropTag & 0xFFFF));
-			return MAPI_E_TOO_COMPLEX;
-		}
+	switch (relop) {
+	case RELOP_LT: return "<";
+	case RELOP_LE: return "<=";
+	case RELOP_GT: return ">";
+	case RELOP_GE: return ">=";
+	case RELOP_EQ: return "=";
+	case RELOP_NE: return "<>";
+	default: return NULL;
 	}
-	return MAPI_E_SUCCESS;
-
 }
 
-static enum MAPISTATUS _table_fetch_messages(MYSQL *conn,
-					     struct openchangedb_table *table,
-					     bool fai, bool live_filtered)
-{
-	TALLOC_CTX				*mem_ctx;
-	char					*sql, *msg_type;
-	const char				*attr, *value;
-	MYSQL_RES				*res = NULL;
-	MYSQL_ROW				row;
-	enum MAPISTATUS				retval;
-	uint64_t				id;
-	size_t 					i;
-	struct openchangedb_table_results	*results;
-	struct openchangedb_table_message_row	*msg_row;
-	struct mapi_SRestriction		*restrictions;
-
-	mem_ctx = talloc_named(NULL, 0, "_table_fetch_messages");
-	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
-
-	OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
-	restrictions = table->restrictions;
-
-	msg_type = talloc_strdup(mem_ctx, fai ? "faiMessage" : "systemMessage");
-	OPENCHANGE_RETVAL_IF(!msg_type, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+/**
+   \details Translate a compiled restriction into a SQL condition
 
-	retval = _table_get_attr_and_value_from_restrictions(mem_ctx, restrictions, &attr, &value);
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
+   \param mem_ctx pointer to the memory context
+   \param program pointer to the compiled restriction
+   \param pc index of the instruction to translate
+   \param is_message whether the rows are messages or folders
+   \param alias alias of the messages or folders table in the query
 
-	if (live_filtered || !restrictions) {
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT m1.id, m1.message_id, m1.normalized_subject "
-			"FROM messages m1 "
-			"JOIN mailboxes mb1 ON mb1.id = m1.mailbox_id "
-			"  AND mb1.folder_id = %"PRIu64" AND mb1.name = '%s' "
-			"WHERE m1.message_type = '%s' "
-			"UNION "
-			"SELECT m2.id, m2.message_id, m2.normalized_subject "
-			"FROM messages m2 "
-			"JOIN folders f ON f.id = m2.folder_id "
-			"  AND f.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb2 ON mb2.id = f.mailbox_id AND mb2.name = '%s' "
-			"WHERE m2.message_type = '%s' "
-			"UNION "
-			"SELECT m.id, m.message_id, m.normalized_subject "
-			"FROM messages m "
-			"JOIN folders f ON f.id = m.folder_id "
-			"  AND f.folder_id = %"PRIu64
-			"  AND f.ou_id = %"PRIu64
-			"  AND f.folder_class = '"PUBLIC_FOLDER"' "
-			"WHERE m2.message_type = '%s' ",
-			table->folder_id, table->username, msg_type,
-			table->folder_id, table->username, msg_type,
-			table->folder_id, table->ou_id, msg_type);
-	} else if (restrictions->res.resProperty.ulPropTag == PidTagMid) {
-		if (!convert_string_to_ull(value, &id)) {
-			OC_DEBUG(0, "Invalid MessageId, conversion failed\n");
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
+   \return the condition, NULL if the restriction has to be evaluated
+   row by row
+ */
+static char *_table_restriction_sql(TALLOC_CTX *mem_ctx,
+				    const struct mapiproxy_restriction *program,
+				    uint32_t pc, bool is_message, const char *alias)
+{
+	const struct mapiproxy_restriction_instr	*instr = &program->instrs[pc];
+	const char					*relop, *attr, *column = NULL;
+	char						*sql = NULL, *child_sql;
+	uint32_t					child;
+	uint64_t					id;
+
+	switch (instr->op) {
+	case MAPIPROXY_RESTRICTION_TRUE:
+		return talloc_strdup(mem_ctx, "1");
+	case MAPIPROXY_RESTRICTION_FALSE:
+		return talloc_strdup(mem_ctx, "0");
+	case MAPIPROXY_RESTRICTION_AND:
+	case MAPIPROXY_RESTRICTION_OR:
+		for (child = pc + 1; child < pc + instr->length; child += program->instrs[child].length) {
+			child_sql = _table_restriction_sql(mem_ctx, program, child, is_message, alias);
+			if (!child_sql) return NULL;
+			if (!sql) {
+				sql = talloc_asprintf(mem_ctx, "(%s)", child_sql);
+			} else {
+				sql = talloc_asprintf_append(sql, " %s (%s)",
+							     (instr->op == MAPIPROXY_RESTRICTION_AND) ? "AND" : "OR",
+							     child_sql);
+			}
+			if (!sql) return NULL;
 		}
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT m1.id, m1.message_id, m1.normalized_subject "
-			"FROM messages m1 "
-			"JOIN mailboxes mb1 ON mb1.id = m1.mailbox_id "
-			"  AND mb1.folder_id = %"PRIu64" AND mb1.name = '%s' "
-			"WHERE m1.message_type = '%s' "
-			"  AND m1.message_id = %"PRIu64" "
-			"UNION "
-			"SELECT m2.id, m2.message_id, m2.normalized_subject "
-			"FROM messages m2 "
-			"JOIN folders f ON f.id = m2.folder_id "
-			"  AND f.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb2 ON mb2.id = f.mailbox_id AND mb2.name = '%s' "
-			"WHERE m2.message_type = '%s'"
-			"  AND m2.message_id = %"PRIu64" "
-			"UNION "
-			"SELECT m.id, m.message_id, m.normalized_subject "
-			"FROM messages m "
-			"JOIN folders f ON f.id = m.folder_id "
-			"  AND f.folder_id = %"PRIu64" "
-			"  AND f.ou_id = %"PRIu64
-			"  AND f.folder_class = '"PUBLIC_FOLDER"' "
-			"WHERE m.message_type = '%s'"
-			"  AND m.message_id = %"PRIu64,
-			table->folder_id, table->username, msg_type, id,
-			table->folder_id, table->username, msg_type, id,
-			table->folder_id, table->ou_id, msg_type, id);
-	} else if (restrictions->res.resProperty.ulPropTag == PidTagNormalizedSubject) {
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT m1.id, m1.message_id, m1.normalized_subject "
-			"FROM messages m1 "
-			"JOIN mailboxes mb1 ON mb1.id = m1.mailbox_id "
-			"  AND mb1.folder_id = %"PRIu64" AND mb1.name = '%s' "
-			"WHERE m1.message_type = '%s' "
-			"  AND m1.normalized_subject = '%s' "
-			"UNION "
-			"SELECT m2.id, m2.message_id, m2.normalized_subject "
-			"FROM messages m2 "
-			"JOIN folders f ON f.id = m2.folder_id "
-			"  AND f.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb2 ON mb2.id = f.mailbox_id AND mb2.name = '%s' "
-			"WHERE m2.message_type = '%s'"
-			"  AND m2.normalized_subject = '%s' "
-			"UNION "
-			"SELECT m.id, m.message_id, m.normalized_subject "
-			"FROM messages m "
-			"JOIN folders f ON f.id = m.folder_id "
-			"  AND f.folder_id = %"PRIu64
-			"  AND f.ou_id = %"PRIu64
-			"  AND f.folder_class = '"PUBLIC_FOLDER"' "
-			"WHERE m.message_type = '%s'"
-			"  AND m.normalized_subject = '%s'",
-			table->folder_id, table->username, msg_type, value,
-			table->folder_id, table->username, msg_type, value,
-			table->folder_id, table->ou_id, msg_type, value);
-	} else {
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT m1.id, m1.message_id, m1.normalized_subject "
-			"FROM messages m1 "
-			"JOIN mailboxes mb1 ON mb1.id = m1.mailbox_id "
-			"  AND mb1.folder_id = %"PRIu64" AND mb1.name = '%s' "
-			"WHERE m1.message_type = '%s' "
-			"  AND EXISTS ("
-			"     SELECT mp.message_id FROM messages_properties mp "
-			"     WHERE mp.message_id = m1.id "
-			"       AND mp.name = '%s' AND mp.value = '%s') "
-			"UNION "
-			"SELECT m2.id, m2.message_id, m2.normalized_subject "
-			"FROM messages m2 "
-			"JOIN folders f ON f.id = m2.folder_id "
-			"  AND f.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb2 ON mb2.id = f.mailbox_id AND mb2.name = '%s' "
-			"WHERE m2.message_type = '%s'"
-			"  AND EXISTS ("
-			"     SELECT mp.message_id FROM messages_properties mp "
-			"     WHERE mp.message_id = m2.id "
-			"       AND mp.name = '%s' AND mp.value = '%s') "
-			"UNION "
-			"SELECT m.id, m.message_id, m.normalized_subject "
-			"FROM messages m "
-			"JOIN folders f ON f.id = m.folder_id "
-			"  AND f.folder_id = %"PRIu64
-			"  AND f.ou_id = %"PRIu64
-			"  AND f.folder_class = '"PUBLIC_FOLDER"' "
-			"WHERE m.message_type = '%s'"
-			"  AND EXISTS ("
-			"     SELECT mp.message_id FROM messages_properties mp "
-			"     WHERE mp.message_id = m.id "
-			"       AND mp.name = '%s' AND mp.value = '%s')",
-			table->folder_id, table->username, msg_type, attr, value,
-			table->folder_id, table->username, msg_type, attr, value,
-			table->folder_id, table->ou_id, msg_type, attr, value);
+		return sql;
+	case MAPIPROXY_RESTRICTION_NOT:
+		child_sql = _table_restriction_sql(mem_ctx, program, pc + 1, is_message, alias);
+		if (!child_sql) return NULL;
+		return talloc_asprintf(mem_ctx, "NOT (%s)", child_sql);
+	case MAPIPROXY_RESTRICTION_COMPARE:
+		break;
+	default:
+		return NULL;
 	}
-	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	retval = status(select_without_fetch(conn, sql, &res));
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
-
-	results = talloc_zero(table, struct openchangedb_table_results);
-	OPENCHANGE_RETVAL_IF(!results, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	table->res = results;
-	results->count = mysql_num_rows(res);
-	results->messages = talloc_array(results, struct openchangedb_table_message_row *,
-					 results->count);
-	OPENCHANGE_RETVAL_IF(!results->messages, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	for (i = 0; i < results->count; i++) {
-		msg_row = talloc_zero(results, struct openchangedb_table_message_row);
-		OPENCHANGE_RETVAL_IF(!msg_row, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-		row = mysql_fetch_row(res);
 
-		if (!convert_string_to_ull(row[0], &msg_row->id)) {
-			OC_DEBUG(0, "Error converting id of msg row\n");
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-		if (!convert_string_to_ull(row[1], &msg_row->mid)) {
-			OC_DEBUG(0, "Error converting mid of msg row\n");
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-		msg_row->normalized_subject = talloc_strdup(results, row[2]);
-		OPENCHANGE_RETVAL_IF(!msg_row->normalized_subject, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	relop = _table_sql_relop(instr->relop);
+	if (!relop) return NULL;
 
-		results->messages[i] = msg_row;
+	if (is_message && instr->proptag == PidTagMid) {
+		column = "message_id";
+	} else if (!is_message && instr->proptag == PidTagFolderId) {
+		column = "folder_id";
 	}
-end:
-	if (res) mysql_free_result(res);
-	talloc_free(mem_ctx);
-	return retval;
-}
-
-static enum MAPISTATUS _table_fetch_folders(MYSQL *conn,
-					    struct openchangedb_table *table,
-					    bool live_filtered)
-{
-	TALLOC_CTX				*mem_ctx;
-	char					*sql;
-	const char				*attr, *value;
-	MYSQL_RES				*res = NULL;
-	MYSQL_ROW				row;
-	enum MAPISTATUS				retval;
-	uint64_t				id;
-	size_t					i;
-	struct openchangedb_table_results	*results;
-	struct openchangedb_table_folder_row	*folder_row;
-	struct mapi_SRestriction		*restrictions;
-
-	mem_ctx = talloc_named(NULL, 0, "_table_fetch_folders");
-	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
-
-	OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
-	restrictions = table->restrictions;
-
-	retval = _table_get_attr_and_value_from_restrictions(mem_ctx, restrictions, &attr, &value);
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
 
-	if (live_filtered || !restrictions) {
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT f1.id, f1.folder_id FROM folders f1 "
-			"JOIN folders f2 ON f2.id = f1.parent_folder_id "
-			"   AND f2.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb1 ON mb1.id = f1.mailbox_id "
-			"   AND mb1.name = '%s' "
-			"UNION "
-			"SELECT f3.id, f3.folder_id FROM folders f3 "
-			"JOIN mailboxes mb2 ON mb2.id = f3.mailbox_id "
-			"   AND mb2.folder_id = %"PRIu64" AND mb2.name = '%s' "
-			"WHERE f3.parent_folder_id IS NULL "
-			"UNION "
-			"SELECT f1.id, f1.folder_id FROM folders f1 "
-			"JOIN folders f2 ON f2.id = f1.parent_folder_id "
-			"   AND f2.folder_id = %"PRIu64" "
-			"WHERE f1.ou_id = %"PRIu64
-			"   AND f1.folder_class = '"PUBLIC_FOLDER"'",
-			table->folder_id, table->username,
-			table->folder_id, table->username,
-			table->folder_id, table->ou_id);
-	} else if (restrictions->res.resProperty.ulPropTag == PidTagFolderId) {
-		if (!convert_string_to_ull(value, &id)) {
-			OC_DEBUG(0, "Invalid FolderId, conversion failed\n");
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
+	if (column) {
+		if (instr->value.type == PT_I8) {
+			id = instr->value.u.i;
+		} else if (instr->value.type != PT_UNICODE || !convert_string_to_ull(instr->value.u.str, &id)) {
+			return NULL;
 		}
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT f1.id, f1.folder_id FROM folders f1 "
-			"JOIN folders f2 ON f2.id = f1.parent_folder_id "
-			"   AND f2.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb1 ON mb1.id = f1.mailbox_id "
-			"   AND mb1.name = '%s' "
-			"WHERE f1.folder_id = %"PRIu64" "
-			"UNION "
-			"SELECT f3.id, f3.folder_id FROM folders f3 "
-			"JOIN mailboxes mb2 ON mb2.id = f3.mailbox_id "
-			"   AND mb2.folder_id = %"PRIu64" AND mb2.name = '%s' "
-			"WHERE f3.parent_folder_id IS NULL"
-			"   AND f3.folder_id = %"PRIu64" "
-			"UNION "
-			"SELECT f1.id, f1.folder_id FROM folders f1 "
-			"JOIN folders f2 ON f2.id = f1.parent_folder_id "
-			"   AND f2.folder_id = %"PRIu64" "
-			"WHERE f1.ou_id = %"PRIu64
-			"   AND f1.folder_id = %"PRIu64" "
-			"   AND f1.folder_class = '"PUBLIC_FOLDER"'",
-			table->folder_id, table->username, id,
-			table->folder_id, table->username, id,
-			table->folder_id, table->ou_id, id);
-	} else {
-		sql = talloc_asprintf(mem_ctx,
-			"SELECT f1.id, f1.folder_id FROM folders f1 "
-			"JOIN folders f2 ON f2.id = f1.parent_folder_id "
-			"   AND f2.folder_id = %"PRIu64" "
-			"JOIN mailboxes mb ON mb.id = f1.mailbox_id "
-			"   AND mb.name = '%s' "
-			"WHERE EXISTS ("
-			"     SELECT fp.folder_id FROM folders_properties fp "
-			"     WHERE fp.folder_id = f1.id "
-			"       AND fp.name = '%s' AND fp.value = '%s') "
-			"UNION "
-			"SELECT f.id, f.folder_id FROM folders f "
-			"JOIN mailboxes mb ON mb.id = f.mailbox_id "
-			"   AND mb.folder_id = %"PRIu64" AND mb.name = '%s' "
-			"WHERE f.parent_folder_id IS NULL"
-			"  AND EXISTS ("
-			"     SELECT fp.folder_id FROM folders_properties fp "
-			"     WHERE fp.folder_id = f.id "
-			"       AND fp.name = '%s' AND fp.value = '%s') "
-			"UNION "
-			"SELECT f1.id, f1.folder_id FROM folders f1 "
-			"JOIN folders f2 ON f2.id = f1.parent_folder_id "
-			"   AND f2.folder_id = %"PRIu64" "
-			"WHERE f1.ou_id = %"PRIu64
-			" AND f1.folder_class = '"PUBLIC_FOLDER"' AND EXISTS ("
-			"     SELECT fp.folder_id FROM folders_properties fp "
-			"     WHERE fp.folder_id = f1.id "
-			"       AND fp.name = '%s' AND fp.value = '%s') ",
-			table->folder_id, table->username, attr, value,
-			table->folder_id, table->username, attr, value,
-			table->folder_id, table->ou_id, attr, value);
+		return talloc_asprintf(mem_ctx, "%s.%s %s %"PRIu64, alias, column, relop, id);
 	}
-	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	retval = status(select_without_fetch(conn, sql, &res));
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, mem_ctx);
 
-	results = talloc_zero(table, struct openchangedb_table_results);
-	OPENCHANGE_RETVAL_IF(!results, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	table->res = results;
-	results->count = mysql_num_rows(res);
-	results->folders = talloc_array(results, struct openchangedb_table_folder_row *,
-					results->count);
-	OPENCHANGE_RETVAL_IF(!results->folders, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-	for (i = 0; i < results->count; i++) {
-		folder_row = talloc_zero(results, struct openchangedb_table_folder_row);
-		OPENCHANGE_RETVAL_IF(!folder_row, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
-		row = mysql_fetch_row(res);
+	if (instr->value.type != PT_UNICODE) return NULL;
+
+	if (is_message && instr->proptag == PidTagNormalizedSubject) {
+		return talloc_asprintf(mem_ctx, "%s.normalized_subject %s '%s'",
+				       alias, relop, _sql(mem_ctx, instr->value.u.str));
+	}
 
-		if (!convert_string_to_ull(row[0], &folder_row->id)) {
-			OC_DEBUG(0, "Error converting id of folder row");
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-		if (!convert_string_to_ull(row[1], &folder_row->fid)) {
-			OC_DEBUG(0, "Error converting fid of folder row");
-			retval = MAPI_E_CALL_FAILED;
-			goto end;
-		}
-		results->folders[i] = folder_row;
+	/* A missing property must not match, which only holds for EXISTS = */
+	if (instr->relop != RELOP_EQ) return NULL;
+	attr = openchangedb_property_get_attribute(instr->proptag);
+	if (!attr) return NULL;
+
+	if (is_message) {
+		return talloc_asprintf(mem_ctx,
+			"EXISTS ("
+			"   SELECT mp.message_id FROM messages_properties mp "
+			"   WHERE mp.message_id = %s.id "
+			"     AND mp.name = '%s' AND mp.value = '%s')",
+			alias, attr, _sql(mem_ctx, instr->value.u.str));
 	}
-end:
-	if (res) mysql_free_result(res);
-	talloc_free(mem_ctx);
-	return MAPI_E_SUCCESS;
+	return talloc_asprintf(mem_ctx,
+		"EXISTS ("
+		"   SELECT fp.folder_id FROM folders_properties fp "
+		"   WHERE fp.folder_id = %s.id "
+		"     AND fp.name = '%s' AND fp.value = '%s')",
+		alias, attr, _sql(mem_ctx, instr->value.u.str));
 }
 
-static enum MAPISTATUS _table_fetch_results(MYSQL *conn,
+/**
+   \details Build the " AND (...)" suffix restricting a table query
+
+   \return the suffix, an empty string if there is nothing to push down
+   to MySQL, NULL if the restriction cannot be expressed in SQL
+ */
+static const char *_table_restriction_where(TALLOC_CTX *mem_ctx,
 					    struct openchangedb_table *table,
-					    bool live_filtered)
+					    bool is_message, const char *alias)
 {
-	bool is_message;
+	char	*cond;
 
-	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
-	OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
+	if (!table->restrictions) return "";
 
-	is_message = table->table_type == 0x3 || table->table_type == 0x2;
+	cond = _table_restriction_sql(mem_ctx, table->restrictions, 0, is_message, alias);
+	if (!cond) return NULL;
 
-	if (is_message) {
-		bool fai = table->table_type == 0x3;
-		return _table_fetch_messages(conn, table, fai, live_filtered);
-	} else {
-		return _table_fetch_folders(conn, table, live_filtered);
-	}
+	return talloc_asprintf(mem_ctx, " AND (%s)", cond);
 }
 
-static bool _table_check_message_match_restrictions(MYSQL *conn,
-						    struct openchangedb_table *table,
-						    bool fai,
-						    struct openchangedb_table_message_row *row)
+static bool is_message_table(struct openchangedb_table *table)
 {
-	TALLOC_CTX			*mem_ctx;
-	char				*sql = NULL, *msg_type = NULL;
-	const char			*attr, *value;
-	struct mapi_SRestriction	*restrictions;
-	uint64_t			id = 0;
-	bool				ret = false;
-
-	mem_ctx = talloc_named(NULL, 0, "_table_check_message_match_restrictions");
-	if (!mem_ctx) return false;
+	return table->table_type == 0x3 || table->table_type == 0x2;
+}
 
-	if (!conn || !table || !row) goto end;
-	restrictions = table->restrictions;
+static bool is_fai_table(struct openchangedb_table *table)
+{
+	return table->table_type == 0x3;
+}
 
-	ret = _table_get_attr_and_value_from_restrictions(mem_ctx, restrictions, &attr, &value);
-	if (ret != MAPI_E_SUCCESS) goto end;
+/**
+   \details Build the query of the rows of a messages table
 
-	if (restrictions->res.resProperty.ulPropTag == PidTagMid) {
-		if (convert_string_to_ull(value, &id)) {
-			ret = row->mid == id;
+   \return the query, ordered on nothing, NULL on failure
+ */
+static char *_table_messages_sql(TALLOC_CTX *mem_ctx,
+				 struct openchangedb_table *table,
+				 bool fai, bool live_filtered)
+{
+	const char	*msg_type;
+	const char	*cond1 = "", *cond2 = "", *cond = "";
+
+	msg_type = fai ? "faiMessage" : "systemMessage";
+
+	/* Push the restriction down to MySQL when it can be expressed
+	   in SQL, rows are filtered in table_get_property otherwise */
+	table->restrictions_in_sql = false;
+	if (!live_filtered && table->restrictions) {
+		cond1 = _table_restriction_where(mem_ctx, table, true, "m1");
+		cond2 = _table_restriction_where(mem_ctx, table, true, "m2");
+		cond = _table_restriction_where(mem_ctx, table, true, "m");
+		if (cond1 && cond2 && cond) {
+			table->restrictions_in_sql = true;
 		} else {
-			OC_DEBUG(0, "Invalid TagMid, conversion failed\n");
+			cond1 = cond2 = cond = "";
 		}
-		goto end;
-	} else if (restrictions->res.resProperty.ulPropTag == PidTagNormalizedSubject) {
-		ret = strcmp(row->normalized_subject, value) == 0;
-		goto end;
 	}
 
-	msg_type = talloc_strdup(mem_ctx, fai ? "faiMessage" : "systemMessage");
-	if (!msg_type) goto end;
-
-	sql = talloc_asprintf(mem_ctx,
-		"SELECT m1.id FROM messages m1 "
+	return talloc_asprintf(mem_ctx,
+		"SELECT m1.id, m1.message_id, m1.normalized_subject "
+		"FROM messages m1 "
 		"JOIN mailboxes mb1 ON mb1.id = m1.mailbox_id "
 		"  AND mb1.folder_id = %"PRIu64" AND mb1.name = '%s' "
-		"WHERE m1.message_type = '%s' "
-		"  AND EXISTS ("
-		"     SELECT mp.message_id FROM messages_properties mp "
-		"     WHERE mp.message_id = m1.id "
-		"       AND mp.name = '%s' AND mp.value = '%s') "
-		"  AND m1.id = %"PRIu64" "
+		"WHERE m1.message_type = '%s'%s "
 		"UNION "
-		"SELECT m2.id FROM messages m2 "
+		"SELECT m2.id, m2.message_id, m2.normalized_subject "
+		"FROM messages m2 "
 		"JOIN folders f ON f.id = m2.folder_id "
 		"  AND f.folder_id = %"PRIu64" "
 		"JOIN mailboxes mb2 ON mb2.id = f.mailbox_id AND mb2.name = '%s' "
-		"WHERE m2.message_type = '%s'"
-		"  AND EXISTS ("
-		"     SELECT mp.message_id FROM messages_properties mp "
-		"     WHERE mp.message_id = m2.id "
-		"       AND mp.name = '%s' AND mp.value = '%s') "
-		"  AND m2.id = %"PRIu64" "
+		"WHERE m2.message_type = '%s'%s "
 		"UNION "
-		"SELECT m.id FROM messages m "
+		"SELECT m.id, m.message_id, m.normalized_subject "
+		"FROM messages m "
 		"JOIN folders f ON f.id = m.folder_id "
 		"  AND f.folder_id = %"PRIu64
 		"  AND f.ou_id = %"PRIu64
 		"  AND f.folder_class = '"PUBLIC_FOLDER"' "
-		"WHERE m2.message_type = '%s'"
-		"  AND EXISTS ("
-		"     SELECT mp.message_id FROM messages_properties mp "
-		"     WHERE mp.message_id = m2.id "
-		"       AND mp.name = '%s' AND mp.value = '%s') "
-		"  AND m2.id = %"PRIu64,
-		table->folder_id, table->username, msg_type, attr, value, row->id,
-		table->folder_id, table->username, msg_type, attr, value, row->id,
-		table->folder_id, table->ou_id, msg_type, attr, value, row->id);
-	if (!sql) goto end;
-	ret = status(select_first_uint(conn, sql, &id)) == MAPI_E_SUCCESS;
-end:
-	talloc_free(mem_ctx);
-	return ret;
+		"WHERE m.message_type = '%s'%s",
+		table->folder_id, table->username, msg_type, cond1,
+		table->folder_id, table->username, msg_type, cond2,
+		table->folder_id, table->ou_id, msg_type, cond);
 }
 
-static bool _table_check_folder_match_restrictions(MYSQL *conn,
-						   struct openchangedb_table *table,
-						   struct openchangedb_table_folder_row *row)
-{
-	TALLOC_CTX			*mem_ctx;
-	char				*sql;
-	const char			*attr, *value;
-	struct mapi_SRestriction	*restrictions;
-	uint64_t			id;
-	bool				ret = false;
-
-	mem_ctx = talloc_named(NULL, 0, "_table_check_folder_match_restrictions");
-	if (!mem_ctx) return false;
-
-	if (!conn || !table || !row) goto end;
-	restrictions = table->restrictions;
-
-	ret = _table_get_attr_and_value_from_restrictions(mem_ctx, restrictions, &attr, &value);
-	if (ret != MAPI_E_SUCCESS) goto end;
+/**
+   \details Build the query of the rows of a hierarchy table
 
-	if (restrictions->res.resProperty.ulPropTag == PidTagFolderId) {
-		if (convert_string_to_ull(value, &id)) {
-			ret = row->fid == id;
+   \return the query, ordered on nothing, NULL on failure
+ */
+static char *_table_folders_sql(TALLOC_CTX *mem_ctx,
+				struct openchangedb_table *table,
+				bool live_filtered)
+{
+	const char	*cond1 = "", *cond3 = "", *cond = "";
+
+	table->restrictions_in_sql = false;
+	if (!live_filtered && table->restrictions) {
+		cond1 = _table_restriction_where(mem_ctx, table, false, "f1");
+		cond3 = _table_restriction_where(mem_ctx, table, false, "f3");
+		cond = _table_restriction_where(mem_ctx, table, false, "f1");
+		if (cond1 && cond3 && cond) {
+			table->restrictions_in_sql = true;
 		} else {
-			OC_DEBUG(0, "Invalid TagFolderId, conversion failed\n");
+			cond1 = cond3 = cond = "";
 		}
-		goto end;
 	}
 
-	sql = talloc_asprintf(mem_ctx,
-		"SELECT f1.id FROM folders f1 "
+	return talloc_asprintf(mem_ctx,
+		"SELECT f1.id, f1.folder_id FROM folders f1 "
 		"JOIN folders f2 ON f2.id = f1.parent_folder_id "
 		"   AND f2.folder_id = %"PRIu64" "
 		"JOIN mailboxes mb1 ON mb1.id = f1.mailbox_id "
 		"   AND mb1.name = '%s' "
-		"WHERE EXISTS ("
-		"     SELECT fp.folder_id FROM folders_properties fp "
-		"     WHERE fp.folder_id = f1.id "
-		"       AND fp.name = '%s' AND fp.value = '%s') "
-		"   AND f1.id = %"PRIu64" "
+		"WHERE 1%s "
 		"UNION "
-		"SELECT f3.id FROM folders f3 "
+		"SELECT f3.id, f3.folder_id FROM folders f3 "
 		"JOIN mailboxes mb2 ON mb2.id = f3.mailbox_id "
 		"   AND mb2.folder_id = %"PRIu64" AND mb2.name = '%s' "
-		"WHERE f3.parent_folder_id IS NULL"
-		"  AND EXISTS ("
-		"     SELECT fp.folder_id FROM folders_properties fp "
-		"     WHERE fp.folder_id = f3.id "
-		"       AND fp.name = '%s' AND fp.value = '%s') "
-		"   AND f3.id = %"PRIu64" "
+		"WHERE f3.parent_folder_id IS NULL%s "
 		"UNION "
-		"SELECT f1.id FROM folders f1 "
+		"SELECT f1.id, f1.folder_id FROM folders f1 "
 		"JOIN folders f2 ON f2.id = f1.parent_folder_id "
 		"   AND f2.folder_id = %"PRIu64" "
 		"WHERE f1.ou_id = %"PRIu64
-		"   AND f1.folder_class = '"PUBLIC_FOLDER"' AND EXISTS ("
-		"     SELECT fp.folder_id FROM folders_properties fp "
-		"     WHERE fp.folder_id = f1.id "
-		"       AND fp.name = '%s' AND fp.value = '%s') "
-		"   AND f1.id = %"PRIu64" ",
-		table->folder_id, table->username, attr, value, row->id,
-		table->folder_id, table->username, attr, value, row->id,
-		table->folder_id, table->ou_id, attr, value, row->id);
-	if (!sql) goto end;
-	ret = status(select_first_uint(conn, sql, &id)) == MAPI_E_SUCCESS;
+		"   AND f1.folder_class = '"PUBLIC_FOLDER"'%s",
+		table->folder_id, table->username, cond1,
+		table->folder_id, table->username, cond3,
+		table->folder_id, table->ou_id, cond);
+}
+
+/**
+   \details Load the rows of a table from a given position: a page of
+   table_page_size rows when the table is paged, all of them otherwise
+
+   \param conn pointer to the MySQL connection
+   \param table pointer to the table
+   \param offset position of the first row to load
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS _table_load_rows(MYSQL *conn,
+					struct openchangedb_table *table,
+					size_t offset)
+{
+	struct openchangedb_table_results	*results = table->res;
+	struct openchangedb_table_message_row	*msg_row;
+	struct openchangedb_table_folder_row	*folder_row;
+	TALLOC_CTX				*page;
+	char					*sql;
+	MYSQL_RES				*res = NULL;
+	MYSQL_ROW				row;
+	enum MAPISTATUS				retval;
+	bool					is_message;
+	size_t					i, count;
+
+	/* Forget the rows loaded before */
+	TALLOC_FREE(results->page);
+	results->window = NULL;
+	results->offset = offset;
+	results->loaded = results->window_offset = results->window_count = 0;
+	results->messages = NULL;
+
+	page = talloc_named(results, 0, "openchangedb_table_page");
+	OPENCHANGE_RETVAL_IF(!page, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	/* Order on the row identifier so pages neither overlap nor skip
+	   rows */
+	if (results->paged) {
+		sql = talloc_asprintf(page, "%s ORDER BY id LIMIT %"PRIu32" OFFSET %zu",
+				      results->sql, table_page_size, offset);
+	} else {
+		sql = talloc_asprintf(page, "%s ORDER BY id", results->sql);
+	}
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, page);
+	retval = status(select_without_fetch(conn, sql, &res));
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, page);
+
+	is_message = is_message_table(table);
+	count = mysql_num_rows(res);
+	if (is_message) {
+		results->messages = talloc_array(page, struct openchangedb_table_message_row *, count);
+	} else {
+		results->folders = talloc_array(page, struct openchangedb_table_folder_row *, count);
+	}
+	if (!results->messages) {
+		retval = MAPI_E_NOT_ENOUGH_MEMORY;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		row = mysql_fetch_row(res);
+		if (is_message) {
+			msg_row = talloc_zero(page, struct openchangedb_table_message_row);
+			if (!msg_row) {
+				retval = MAPI_E_NOT_ENOUGH_MEMORY;
+				goto end;
+			}
+			if (!convert_string_to_ull(row[0], &msg_row->id) ||
+			    !convert_string_to_ull(row[1], &msg_row->mid)) {
+				OC_DEBUG(0, "Error converting ids of msg row\n");
+				retval = MAPI_E_CALL_FAILED;
+				goto end;
+			}
+			msg_row->normalized_subject = talloc_strdup(msg_row, row[2]);
+			results->messages[i] = msg_row;
+		} else {
+			folder_row = talloc_zero(page, struct openchangedb_table_folder_row);
+			if (!folder_row) {
+				retval = MAPI_E_NOT_ENOUGH_MEMORY;
+				goto end;
+			}
+			if (!convert_string_to_ull(row[0], &folder_row->id) ||
+			    !convert_string_to_ull(row[1], &folder_row->fid)) {
+				OC_DEBUG(0, "Error converting ids of folder row");
+				retval = MAPI_E_CALL_FAILED;
+				goto end;
+			}
+			results->folders[i] = folder_row;
+		}
+	}
+
+	results->page = page;
+	results->loaded = count;
+	if (!results->paged) {
+		results->count = count;
+	}
 end:
-	talloc_free(mem_ctx);
-	return ret;
+	mysql_free_result(res);
+	if (retval != MAPI_E_SUCCESS) {
+		results->messages = NULL;
+		talloc_free(page);
+	}
+	return retval;
 }
 
-static bool _table_check_match_restrictions(MYSQL *conn,
+/**
+   \details Set up the results of a table. Tables whose restriction
+   MySQL evaluates, or which are live filtered, are counted and then
+   fetched a page at a time. The others are fetched at once, to be
+   filtered row by row.
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND for empty
+   tables, otherwise MAPI error
+ */
+static enum MAPISTATUS _table_fetch_results(MYSQL *conn,
 					    struct openchangedb_table *table,
-					    uint32_t pos)
+					    bool live_filtered)
 {
-	bool is_message;
+	struct openchangedb_table_results	*results;
+	char					*sql, *count_sql;
+	enum MAPISTATUS				retval;
+	uint64_t				count = 0;
 
-	if (!conn || !table) return false;
+	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
 
-	if (!table->restrictions) return true;
+	results = talloc_zero(table, struct openchangedb_table_results);
+	OPENCHANGE_RETVAL_IF(!results, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 
-	is_message = table->table_type == 0x3 || table->table_type == 0x2;
-	if (is_message) {
-		bool fai = table->table_type == 0x3;
-		return _table_check_message_match_restrictions(conn, table, fai, table->res->messages[pos]);
+	if (is_message_table(table)) {
+		sql = _table_messages_sql(results, table, is_fai_table(table), live_filtered);
 	} else {
-		return _table_check_folder_match_restrictions(conn, table, table->res->folders[pos]);
+		sql = _table_folders_sql(results, table, live_filtered);
+	}
+	OPENCHANGE_RETVAL_IF(!sql, MAPI_E_NOT_ENOUGH_MEMORY, results);
+	results->sql = sql;
+
+	if (live_filtered || !table->restrictions || table->restrictions_in_sql) {
+		results->paged = true;
+		count_sql = talloc_asprintf(results, "SELECT COUNT(*) FROM (%s) t", sql);
+		OPENCHANGE_RETVAL_IF(!count_sql, MAPI_E_NOT_ENOUGH_MEMORY, results);
+		retval = status(select_first_uint(conn, count_sql, &count));
+		talloc_free(count_sql);
+		OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, results);
+		OPENCHANGE_RETVAL_IF(!count, MAPI_E_NOT_FOUND, results);
+		results->count = count;
+		table->res = results;
+	} else {
+		table->res = results;
+		retval = _table_load_rows(conn, table, 0);
+		if (retval != MAPI_E_SUCCESS) {
+			TALLOC_FREE(table->res);
+			return retval;
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Return the identifier and the properties of a loaded row
+ */
+static struct openchangedb_table_row_properties **_table_row_properties(struct openchangedb_table *table,
+									size_t pos, uint64_t *id)
+{
+	struct openchangedb_table_results	*results = table->res;
+
+	if (is_message_table(table)) {
+		*id = results->messages[pos - results->offset]->id;
+		return &results->messages[pos - results->offset]->props;
+	}
+	*id = results->folders[pos - results->offset]->id;
+	return &results->folders[pos - results->offset]->props;
+}
+
+/**
+   \details Load the properties of a loaded row, together with the
+   ones of the rows following it in the page, in a single query
+
+   \param conn pointer to the MySQL connection
+   \param table pointer to the table
+   \param pos position of the row
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS _table_load_properties(MYSQL *conn,
+					      struct openchangedb_table *table,
+					      size_t pos)
+{
+	struct openchangedb_table_results		*results = table->res;
+	struct openchangedb_table_row_properties	**props, *row_props = NULL;
+	TALLOC_CTX					*window;
+	char						*sql;
+	MYSQL_RES					*res = NULL;
+	MYSQL_ROW					row;
+	enum MAPISTATUS					retval;
+	uint64_t					id, row_id = 0;
+	size_t						i, count, next;
+
+	if (pos >= results->window_offset && pos < results->window_offset + results->window_count) {
+		return MAPI_E_SUCCESS;
 	}
+
+	/* Forget the properties of the previous rows */
+	for (i = results->window_offset; i < results->window_offset + results->window_count; i++) {
+		*_table_row_properties(table, i, &id) = NULL;
+	}
+	TALLOC_FREE(results->window);
+	results->window_count = 0;
+
+	window = talloc_named(results->page, 0, "openchangedb_table_window");
+	OPENCHANGE_RETVAL_IF(!window, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	count = MIN(table_page_size, results->offset + results->loaded - pos);
+	sql = talloc_strdup(window, is_message_table(table) ?
+			    "SELECT mp.message_id, mp.name, mp.value FROM messages_properties mp "
+			    "WHERE mp.message_id IN (" :
+			    "SELECT fp.folder_id, fp.name, fp.value FROM folders_properties fp "
+			    "WHERE fp.folder_id IN (");
+	for (i = pos; sql && i < pos + count; i++) {
+		props = _table_row_properties(table, i, &id);
+		*props = talloc_zero(window, struct openchangedb_table_row_properties);
+		if (!*props) {
+			retval = MAPI_E_NOT_ENOUGH_MEMORY;
+			goto end;
+		}
+		sql = talloc_asprintf_append(sql, "%s%"PRIu64, (i == pos) ? "" : ",", id);
+	}
+	if (sql) {
+		sql = talloc_asprintf_append(sql, ") ORDER BY 1");
+	}
+	if (!sql) {
+		retval = MAPI_E_NOT_ENOUGH_MEMORY;
+		goto end;
+	}
+
+	retval = status(select_without_fetch(conn, sql, &res));
+	if (retval == MAPI_E_NOT_FOUND) {
+		retval = MAPI_E_SUCCESS;
+		goto end;
+	}
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	/* Properties come in the order of the rows */
+	next = pos;
+	while ((row = mysql_fetch_row(res)) != NULL) {
+		if (!convert_string_to_ull(row[0], &id)) continue;
+		while ((!row_props || row_id != id) && next < pos + count) {
+			row_props = *_table_row_properties(table, next++, &row_id);
+		}
+		if (row_id != id) break;
+
+		row_props->names = talloc_realloc(row_props, row_props->names, const char *, row_props->count + 1);
+		row_props->values = talloc_realloc(row_props, row_props->values, const char *, row_props->count + 1);
+		if (!row_props->names || !row_props->values) {
+			retval = MAPI_E_NOT_ENOUGH_MEMORY;
+			goto end;
+		}
+		row_props->names[row_props->count] = talloc_strdup(row_props, row[1]);
+		row_props->values[row_props->count] = talloc_strdup(row_props, row[2]);
+		row_props->count++;
+	}
+
+end:
+	if (res) mysql_free_result(res);
+	if (retval != MAPI_E_SUCCESS) {
+		for (i = pos; i < pos + count; i++) {
+			*_table_row_properties(table, i, &id) = NULL;
+		}
+		talloc_free(window);
+		return retval;
+	}
+
+	results->window = window;
+	results->window_offset = pos;
+	results->window_count = count;
+
+	return MAPI_E_SUCCESS;
+}
+
+static const char *_table_row_property(struct openchangedb_table_row_properties *props,
+				       const char *attr)
+{
+	size_t	i;
+
+	if (!props) return NULL;
+
+	for (i = 0; i < props->count; i++) {
+		if (props->names[i] && !strcmp(props->names[i], attr)) {
+			return props->values[i];
+		}
+	}
+
+	return NULL;
 }
 
 static const char *_table_fetch_message_attribute(MYSQL *conn,
@@ -2971,38 +3675,25 @@ static const char *_table_fetch_message_attribute(MYSQL *conn,
 						  uint32_t pos,
 						  enum MAPITAGS proptag)
 {
-	const char				*value = NULL;
 	struct openchangedb_table_message_row	*row;
+	const char				*attr;
 
-	if (!conn || !table) return NULL;
-	if (!table->res || !table->res->messages || !table->res->messages[pos]) return NULL;
+	if (!conn || !table || !table->res || !table->res->messages) return NULL;
+	if (pos < table->res->offset || pos >= table->res->offset + table->res->loaded) return NULL;
 
-	row = table->res->messages[pos];
+	row = table->res->messages[pos - table->res->offset];
 
 	if (proptag == PidTagMid) {
-		value = talloc_asprintf(table->res, "%"PRIu64, row->mid);
+		return talloc_asprintf(table->res->page, "%"PRIu64, row->mid);
 	} else if (proptag == PidTagNormalizedSubject) {
-		value = talloc_strdup(table->res, row->normalized_subject);
-	} else {
-		const char	*attr;
-		char		*sql;
-
-		attr = openchangedb_property_get_attribute(proptag);
-		if (!attr) return NULL;
-		sql = talloc_asprintf(NULL,
-			"SELECT mp.value FROM messages_properties mp "
-			"WHERE mp.message_id = %"PRIu64" AND mp.name = '%s'",
-			row->id, attr);
-		if (!sql) return NULL;
-		select_first_string(table->res, conn, sql, &value);
-		talloc_free(sql);
-	}
-
-	if (value) {
-		return (const char *)talloc_strdup(table->res, value);
-	} else {
-		return NULL;
+		return row->normalized_subject;
 	}
+
+	attr = openchangedb_property_get_attribute(proptag);
+	if (!attr) return NULL;
+	if (_table_load_properties(conn, table, pos) != MAPI_E_SUCCESS) return NULL;
+
+	return _table_row_property(row->props, attr);
 }
 
 static const char *_table_fetch_folder_attribute(MYSQL *conn,
@@ -3010,55 +3701,117 @@ static const char *_table_fetch_folder_attribute(MYSQL *conn,
 						 uint32_t pos,
 						 enum MAPITAGS proptag)
 {
-	const char				*value = NULL;
 	struct openchangedb_table_folder_row	*row;
+	const char				*attr;
 
-	if (!conn || !table) return NULL;
-	if (!table->res || !table->res->folders || !table->res->folders[pos]) return NULL;
+	if (!conn || !table || !table->res || !table->res->folders) return NULL;
+	if (pos < table->res->offset || pos >= table->res->offset + table->res->loaded) return NULL;
 
-	row = table->res->folders[pos];
+	row = table->res->folders[pos - table->res->offset];
 
 	if (proptag == PidTagFolderId) {
-		value = talloc_asprintf(table->res, "%"PRIu64, row->fid);
-	} else {
-		const char	*attr;
-		char		*sql;
-
-		attr = openchangedb_property_get_attribute(proptag);
-		if (!attr) return NULL;
-		sql = talloc_asprintf(NULL,
-			"SELECT fp.value FROM folders_properties fp "
-			"WHERE fp.folder_id = %"PRIu64" AND fp.name = '%s'",
-			row->id, attr);
-		if (!sql) return NULL;
-		select_first_string(table->res, conn, sql, &value);
-		talloc_free(sql);
+		return talloc_asprintf(table->res->page, "%"PRIu64, row->fid);
 	}
 
-	if (value) {
-		return (const char *)talloc_strdup(table->res, value);
-	} else {
-		return NULL;
-	}
+	attr = openchangedb_property_get_attribute(proptag);
+	if (!attr) return NULL;
+	if (_table_load_properties(conn, table, pos) != MAPI_E_SUCCESS) return NULL;
+
+	return _table_row_property(row->props, attr);
 }
 
+/**
+   \details Fetch a property of a row. The value belongs to the table
+   and only lasts until the next row is fetched.
+ */
 static const char *_table_fetch_attribute(MYSQL *conn,
 					  struct openchangedb_table *table,
 					  uint32_t pos, enum MAPITAGS proptag)
 {
-	bool is_message;
-
 	if (!conn || !table) return NULL;
 
-	is_message = table->table_type == 0x3 || table->table_type == 0x2;
-
-	if (is_message) {
+	if (is_message_table(table)) {
 		return _table_fetch_message_attribute(conn, table, pos, proptag);
 	} else {
 		return _table_fetch_folder_attribute(conn, table, pos, proptag);
 	}
 }
 
+struct openchangedb_table_row_context {
+	TALLOC_CTX			*mem_ctx;
+	MYSQL				*conn;
+	struct openchangedb_table	*table;
+	uint32_t			pos;
+};
+
+static enum MAPISTATUS _table_row_get_property(void *private_data, enum MAPITAGS proptag, void **data)
+{
+	struct openchangedb_table_row_context	*row_ctx = (struct openchangedb_table_row_context *)private_data;
+	const char				*value;
+
+	value = _table_fetch_attribute(row_ctx->conn, row_ctx->table, row_ctx->pos, proptag);
+	OPENCHANGE_RETVAL_IF(value == NULL, MAPI_E_NOT_FOUND, NULL);
+
+	*data = get_property_data(row_ctx->mem_ctx, proptag, value);
+	OPENCHANGE_RETVAL_IF(*data == NULL, MAPI_E_NOT_FOUND, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+static bool _table_check_match_restrictions(MYSQL *conn,
+					    struct openchangedb_table *table,
+					    uint32_t pos)
+{
+	struct openchangedb_table_row_context	row_ctx;
+	bool					ret;
+
+	if (!conn || !table) return false;
+
+	if (!table->restrictions) return true;
+
+	row_ctx.mem_ctx = talloc_new(NULL);
+	if (!row_ctx.mem_ctx) return false;
+	row_ctx.conn = conn;
+	row_ctx.table = table;
+	row_ctx.pos = pos;
+
+	ret = mapiproxy_restriction_match(table->restrictions, _table_row_get_property, &row_ctx);
+	talloc_free(row_ctx.mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Drop the rows not matching a restriction MySQL could not
+   evaluate
+ */
+static void _table_filter_results(MYSQL *conn, struct openchangedb_table *table)
+{
+	struct openchangedb_table_results	*res = table->res;
+	bool					is_message;
+	size_t					i, count = 0;
+	uint64_t				id;
+
+	is_message = is_message_table(table);
+	for (i = 0; i < res->loaded; i++) {
+		if (!_table_check_match_restrictions(conn, table, i)) continue;
+		if (is_message) {
+			res->messages[count++] = res->messages[i];
+		} else {
+			res->folders[count++] = res->folders[i];
+		}
+	}
+
+	/* Rows moved, their properties are loaded again when needed */
+	for (i = 0; i < res->loaded; i++) {
+		*_table_row_properties(table, i, &id) = NULL;
+	}
+	TALLOC_FREE(res->window);
+	res->window_offset = res->window_count = 0;
+
+	res->count = res->loaded = count;
+}
+
 static enum MAPISTATUS table_get_property(TALLOC_CTX *mem_ctx,
 					  struct openchangedb_context *self,
 					  void *_table,
@@ -3079,12 +3832,22 @@ static enum MAPISTATUS table_get_property(TALLOC_CTX *mem_ctx,
 	if (!table->res) {
 		retval = _table_fetch_results(conn, table, live_filtered);
 		OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
+		if (!live_filtered && table->restrictions && !table->restrictions_in_sql) {
+			_table_filter_results(conn, table);
+		}
 	}
 	res = table->res;
 
 	// Ensure position is within search results range
 	OPENCHANGE_RETVAL_IF(pos >= res->count, MAPI_E_INVALID_OBJECT, NULL);
 
+	/* Load the page of the row */
+	if (pos < res->offset || pos >= res->offset + res->loaded) {
+		retval = _table_load_rows(conn, table, pos - pos % table_page_size);
+		OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
+		OPENCHANGE_RETVAL_IF(pos >= res->offset + res->loaded, MAPI_E_INVALID_OBJECT, NULL);
+	}
+
 	/* If live filtering, make sure the specified row match the restrictions */
 	if (live_filtered) {
 		if (!_table_check_match_restrictions(conn, table, pos)) {
@@ -3734,11 +4497,40 @@ _PUBLIC_
 enum MAPISTATUS openchangedb_mysql_initialize(TALLOC_CTX *mem_ctx,
 					      struct loadparm_context *lp_ctx,
 					      struct openchangedb_context **ctx)
+{
+	const char	*connection_string;
+
+	connection_string = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "openchangedb");
+	if (!connection_string) {
+		OC_DEBUG(0, "mapiproxy:openchangedb must be defined");
+		return MAPI_E_INVALID_PARAMETER;
+	}
+
+	return openchangedb_mysql_initialize_url(mem_ctx, lp_ctx, connection_string, ctx);
+}
+
+/**
+   \details Initialize an openchangedb context on a given MySQL
+   database rather than the one of mapiproxy:openchangedb
+
+   \param mem_ctx pointer to the memory context
+   \param lp_ctx pointer to the loadparm context
+   \param connection_string the MySQL connection string
+   \param ctx pointer on pointer to the openchangedb context to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_
+enum MAPISTATUS openchangedb_mysql_initialize_url(TALLOC_CTX *mem_ctx,
+						  struct loadparm_context *lp_ctx,
+						  const char *connection_string,
+						  struct openchangedb_context **ctx)
 {
 	struct openchangedb_context 	*oc_ctx;
 	MYSQL				*conn = NULL;
-	const char			*connection_string;
 	int				schema_created_ret;
+	int				pool_size;
+	int				page_size;
 
 	oc_ctx = talloc_zero(mem_ctx, struct openchangedb_context);
 	// Initialize context with function pointers
@@ -3765,7 +4557,20 @@ enum MAPISTATUS openchangedb_mysql_initialize(TALLOC_CTX *mem_ctx,
 	oc_ctx->lookup_folder_property = lookup_folder_property;
 	oc_ctx->set_folder_properties = set_folder_properties;
 	oc_ctx->get_folder_property = get_folder_property;
+	oc_ctx->get_folder_properties = get_folder_properties;
 	oc_ctx->get_folder_count = get_folder_count;
+	oc_ctx->get_folder_tree = get_folder_tree;
+	oc_ctx->get_recursive_folder_count = get_recursive_folder_count;
+	oc_ctx->set_recursive_folder_count = set_recursive_folder_count;
+	oc_ctx->update_recursive_folder_counts = update_recursive_folder_counts;
+	oc_ctx->clear_recursive_folder_counts = clear_recursive_folder_counts;
+	oc_ctx->get_hierarchy_change_number = get_hierarchy_change_number;
+	oc_ctx->set_hierarchy_change_numbers = set_hierarchy_change_numbers;
+	oc_ctx->clear_hierarchy_change_numbers = clear_hierarchy_change_numbers;
+	oc_ctx->get_message_counts = get_message_counts;
+	oc_ctx->set_message_counts = set_message_counts;
+	oc_ctx->update_message_counts = update_message_counts;
+	oc_ctx->clear_message_counts = clear_message_counts;
 	oc_ctx->get_message_count = get_message_count;
 	oc_ctx->get_system_idx = get_system_idx;
 	oc_ctx->set_system_idx = set_system_idx;
@@ -3800,11 +4605,14 @@ enum MAPISTATUS openchangedb_mysql_initialize(TALLOC_CTX *mem_ctx,
 	oc_ctx->set_locale = set_locale;
 	oc_ctx->get_folders_names = get_folders_names;
 
-	connection_string = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "openchangedb");
 	if (!connection_string) {
-		OC_DEBUG(0, "mapiproxy:openchangedb must be defined");
 		OPENCHANGE_RETVAL_ERR(MAPI_E_INVALID_PARAMETER, oc_ctx);
 	}
+	pool_size = lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "mysql_pool_size", MYSQL_POOL_SIZE);
+	mysql_pool_set_size(pool_size > 0 ? pool_size : 0);
+	page_size = lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "openchangedb_table_page_size",
+				   OPENCHANGEDB_TABLE_PAGE_SIZE);
+	table_page_size = page_size > 0 ? page_size : 1;
 	// Connect to mysql
 	create_connection(connection_string, &conn);
 	OPENCHANGE_RETVAL_IF(!conn, MAPI_E_NOT_INITIALIZED, oc_ctx);
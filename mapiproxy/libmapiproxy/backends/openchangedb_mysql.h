@@ -26,6 +26,10 @@
 
 #define MAX_PUBLIC_FOLDER_ID 1000
 
+/* Number of rows of a table fetched at once */
+#define OPENCHANGEDB_TABLE_PAGE_SIZE 100
+
 enum MAPISTATUS openchangedb_mysql_initialize(TALLOC_CTX *, struct loadparm_context *, struct openchangedb_context **);
+enum MAPISTATUS openchangedb_mysql_initialize_url(TALLOC_CTX *, struct loadparm_context *, const char *, struct openchangedb_context **);
 
 #endif /* __OPENCHANGEDB_MYSQL_H__ */
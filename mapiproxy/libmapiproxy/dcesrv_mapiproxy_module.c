@@ -135,6 +135,31 @@ NTSTATUS mapiproxy_module_dispatch(struct dcesrv_call_state *dce_call,
 }
 
 
+/**
+   \details Check whether a loaded mapiproxy module hooks the calls of
+   an endpoint
+
+   \param endpoint the name of the endpoint
+
+   \return true if at least one module applies to the endpoint,
+   otherwise false
+ */
+_PUBLIC_ bool mapiproxy_module_loaded(const char *endpoint)
+{
+	struct mapiproxy_module_list	*mpm;
+
+	for (mpm = mpm_list; mpm; mpm = mpm->next) {
+		if (mpm->module->endpoint &&
+		    ((strcmp(mpm->module->endpoint, "any") == 0) ||
+		     (endpoint && (strcmp(endpoint, mpm->module->endpoint) == 0)))) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 NTSTATUS mapiproxy_module_unbind(struct server_id server_id, uint32_t context_id)
 {
 	struct mapiproxy_module_list	*mpm;
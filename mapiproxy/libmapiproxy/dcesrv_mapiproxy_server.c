@@ -24,6 +24,10 @@
 #include "libmapiproxy.h"
 #include "utils/dlinklist.h"
 
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
 /**
    \file dcesrv_mapiproxy_server.c
 
@@ -39,6 +43,26 @@ static struct mapiproxy_module_list	*server_list = NULL;
 
 static TDB_CONTEXT			*emsabp_tdb_ctx = NULL;
 static void				*openchange_ldb_ctx = NULL;
+static struct ldb_context		*samdb_ldb_ctx = NULL;
+
+#if defined(HAVE_PTHREADS)
+/* Serializes the servers' use of the shared contexts above once a
+   server runs calls from threads of its own */
+static bool				server_lock_enabled = false;
+static pthread_mutex_t			server_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread uint32_t		server_lock_depth = 0;
+#endif
+
+/* Expose samdb_connect prototypes */
+struct ldb_context *samdb_connect(TALLOC_CTX *, struct tevent_context *,
+				  struct loadparm_context *,
+				  struct auth_session_info *,
+				  unsigned int);
+struct ldb_context *samdb_connect_url(TALLOC_CTX *, struct tevent_context *,
+				      struct loadparm_context *,
+				      struct auth_session_info *,
+				      unsigned int, const char *);
+void tevent_loop_allow_nesting(struct tevent_context *);
 
 NTSTATUS mapiproxy_server_dispatch(struct dcesrv_call_state *dce_call,
 				   TALLOC_CTX *mem_ctx, void *r,
@@ -117,6 +141,33 @@ _PUBLIC_ bool mapiproxy_server_loaded(const char *endpoint)
 }
 
 
+/**
+   \details Return the server dispatching the calls of an endpoint
+
+   \param endpoint the name of the endpoint
+
+   \return the loaded server module if it is the only one with a
+   dispatch function for the endpoint, otherwise NULL
+ */
+_PUBLIC_ const struct mapiproxy_module *mapiproxy_server_byendpoint(const char *endpoint)
+{
+	struct mapiproxy_module_list	*server;
+	const struct mapiproxy_module	*found = NULL;
+
+	if (!endpoint) return NULL;
+
+	for (server = server_list; server; server = server->next) {
+		if (server->module->endpoint && server->module->dispatch &&
+		    !strcmp(endpoint, server->module->endpoint)) {
+			if (found) return NULL;
+			found = server->module;
+		}
+	}
+
+	return found;
+}
+
+
 static NTSTATUS mapiproxy_server_overwrite(TALLOC_CTX *mem_ctx, const char *name, const char *endpoint)
 {
 	struct mapiproxy_module_list	*server;
@@ -350,3 +401,246 @@ _PUBLIC_ void *mapiproxy_server_openchangedb_init(struct loadparm_context *lp_ct
 
 	return openchange_ldb_ctx;
 }
+
+
+/* openchangedb contexts of the organizations with their own database */
+struct mapiproxy_server_tenant {
+	struct mapiproxy_server_tenant	*prev;
+	struct mapiproxy_server_tenant	*next;
+	char				*url;
+	struct openchangedb_context	*oc_ctx;
+};
+
+static struct mapiproxy_server_tenant	*openchangedb_tenants = NULL;
+
+
+/**
+   \details Retrieve the organization of a user from its
+   legacyExchangeDN, formatted as /o=organization/ou=group/cn=...
+ */
+static char *mapiproxy_server_user_organization(TALLOC_CTX *mem_ctx, struct ldb_context *samdb_ctx,
+						const char *username)
+{
+	struct ldb_result	*res = NULL;
+	const char * const	attrs[] = { "legacyExchangeDN", NULL };
+	const char		*dn;
+	const char		*org, *ou;
+	int			ret;
+
+	ret = ldb_search(samdb_ctx, mem_ctx, &res, ldb_get_default_basedn(samdb_ctx),
+			 LDB_SCOPE_SUBTREE, attrs, "(&(objectClass=user)(sAMAccountName=%s))",
+			 ldb_binary_encode_string(mem_ctx, username));
+	if (ret != LDB_SUCCESS || res->count != 1) return NULL;
+
+	dn = ldb_msg_find_attr_as_string(res->msgs[0], "legacyExchangeDN", NULL);
+	if (!dn) return NULL;
+	org = strstr(dn, "/o=");
+	if (!org) return NULL;
+	ou = strstr(org, "/ou=");
+	if (!ou) return NULL;
+
+	return talloc_strndup(mem_ctx, org + 3, ou - org - 3);
+}
+
+
+/**
+   \details Retrieve the openchangedb context holding the mailbox of
+   a user. When mapiproxy:openchangedb_tenants is enabled, the
+   organization of the user is looked up in samdb and the database
+   set with openchangedb_tenant:ORGANIZATION is used, otherwise the
+   context of mapiproxy_server_openchangedb_init().
+
+   The context of each database is opened once and shared by the
+   sessions of the process, as the default one.
+
+   \param lp_ctx pointer to the loadparm context
+   \param username the account name of the user
+
+   \return Allocated openchangedb context on success, otherwise NULL
+ */
+_PUBLIC_ void *mapiproxy_server_openchangedb_user_init(struct loadparm_context *lp_ctx, const char *username)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct ldb_context		*samdb_ctx;
+	struct mapiproxy_server_tenant	*tenant;
+	struct openchangedb_context	*oc_ctx = NULL;
+	char				*organization;
+	const char			*url;
+	enum MAPISTATUS			ret;
+
+	/* Sanity checks */
+	if (!lp_ctx) return NULL;
+
+	if (!username || !lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "openchangedb_tenants", false)) {
+		return mapiproxy_server_openchangedb_init(lp_ctx);
+	}
+
+	samdb_ctx = mapiproxy_server_samdb_init(lp_ctx);
+	if (!samdb_ctx) return NULL;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return NULL;
+
+	organization = mapiproxy_server_user_organization(mem_ctx, samdb_ctx, username);
+	url = organization ? lpcfg_parm_string(lp_ctx, NULL, "openchangedb_tenant", organization) : NULL;
+	if (!url) {
+		talloc_free(mem_ctx);
+		return mapiproxy_server_openchangedb_init(lp_ctx);
+	}
+
+	for (tenant = openchangedb_tenants; tenant; tenant = tenant->next) {
+		if (!strcmp(tenant->url, url)) {
+			talloc_free(mem_ctx);
+			return tenant->oc_ctx;
+		}
+	}
+
+	tenant = talloc_zero(NULL, struct mapiproxy_server_tenant);
+	if (!tenant) {
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+	tenant->url = talloc_strdup(tenant, url);
+	if (!tenant->url) {
+		talloc_free(tenant);
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+
+	ret = openchangedb_initialize_url(tenant, lp_ctx, url, &oc_ctx);
+	if (ret != MAPI_E_SUCCESS) {
+		OC_DEBUG(0, "unable to open the openchangedb of organization '%s': %s",
+			 organization, mapi_get_errstr(ret));
+		talloc_free(tenant);
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+	tenant->oc_ctx = oc_ctx;
+	DLIST_ADD(openchangedb_tenants, tenant);
+	OC_DEBUG(3, "openchangedb of organization '%s' opened", organization);
+
+	talloc_free(mem_ctx);
+	return tenant->oc_ctx;
+}
+
+
+/**
+   \details Initialize a samdb connection available to all mapiproxy
+   instances. The emsmdb, nspi and asyncemsmdb providers of a process
+   share this connection instead of opening one each.
+
+   The providers only read samdb: when
+   dcerpc_mapiproxy:samdb_replica_url is set, the connection is opened
+   read-only on this URL, for example a LDAP replica close to the
+   server. Otherwise dcerpc_mapiproxy:samdb_url or the local samdb is
+   used.
+
+   \param lp_ctx pointer to the loadparm context
+
+   \note The connection lasts as long as the process, as the
+   openchangedb context does.
+
+   \return Allocated ldb context on success, otherwise NULL
+ */
+_PUBLIC_ struct ldb_context *mapiproxy_server_samdb_init(struct loadparm_context *lp_ctx)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tevent_context	*ev;
+	const char		*samdb_url;
+
+	/* Sanity checks */
+	if (samdb_ldb_ctx) return samdb_ldb_ctx;
+
+	mem_ctx = talloc_named(NULL, 0, "mapiproxy_server_samdb_init");
+	if (!mem_ctx) return NULL;
+
+	ev = tevent_context_init(mem_ctx);
+	if (!ev) {
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+	tevent_loop_allow_nesting(ev);
+
+	/* Retrieve samdb url (replica, external or local) */
+	samdb_url = lpcfg_parm_string(lp_ctx, NULL, "dcerpc_mapiproxy", "samdb_replica_url");
+	if (samdb_url) {
+		samdb_ldb_ctx = samdb_connect_url(mem_ctx, ev, lp_ctx, system_session(lp_ctx),
+						  LDB_FLG_RDONLY|LDB_FLG_RECONNECT, samdb_url);
+	} else {
+		samdb_url = lpcfg_parm_string(lp_ctx, NULL, "dcerpc_mapiproxy", "samdb_url");
+		if (!samdb_url) {
+			samdb_ldb_ctx = samdb_connect(mem_ctx, ev, lp_ctx, system_session(lp_ctx), 0);
+		} else {
+			samdb_ldb_ctx = samdb_connect_url(mem_ctx, ev, lp_ctx, system_session(lp_ctx),
+							  LDB_FLG_RECONNECT, samdb_url);
+		}
+	}
+
+	if (!samdb_ldb_ctx) {
+		OC_DEBUG(0, "unable to connect to samdb%s%s", samdb_url ? " at " : "", samdb_url ? samdb_url : "");
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+	OC_DEBUG(3, "samdb connection shared by the process: %zu bytes", talloc_total_size(mem_ctx));
+
+	return samdb_ldb_ctx;
+}
+
+
+/**
+   \details Make mapiproxy_server_lock serialize the threads of the
+   process. A server calls it before it starts threads that use the
+   shared samdb and openchangedb contexts, or its own state shared with
+   the event loop.
+
+   \return true if the lock is enabled, otherwise false
+ */
+_PUBLIC_ bool mapiproxy_server_lock_enable(void)
+{
+#if defined(HAVE_PTHREADS)
+	server_lock_enabled = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/**
+   \details Take the process lock before using the shared contexts.
+   Every server takes it around its calls, so that the calls run by the
+   threads of one of them never overlap the calls of the others. Does
+   nothing until mapiproxy_server_lock_enable was called. A thread may
+   take the lock again while it holds it.
+ */
+_PUBLIC_ void mapiproxy_server_lock(void)
+{
+#if defined(HAVE_PTHREADS)
+	if (!server_lock_enabled) return;
+
+	if (server_lock_depth++ == 0) {
+		pthread_mutex_lock(&server_lock);
+	}
+#endif
+}
+
+
+/**
+   \details Release the process lock taken with mapiproxy_server_lock
+
+   \return true if the current thread held the lock, otherwise false
+ */
+_PUBLIC_ bool mapiproxy_server_unlock(void)
+{
+#if defined(HAVE_PTHREADS)
+	if (server_lock_depth == 0) return false;
+
+	if (--server_lock_depth == 0) {
+		pthread_mutex_unlock(&server_lock);
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
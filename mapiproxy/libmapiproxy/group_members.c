@@ -0,0 +1,328 @@
+/*
+   OpenChange Server implementation
+
+   Distribution list expansion
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file group_members.c
+
+   \brief Flattened group membership shared by the NSPI and EMSMDB
+   servers
+
+   Expanding a group searches SAMDB once for the group and once per
+   nested group. The process keeps the members found, without the
+   nested groups and without duplicates, for the last groups it
+   expanded.
+
+   The uSNChanged of a group is raised whenever its members change.
+   Before using the cache, the groups changed since the highest
+   uSNChanged known are searched, at most once per second, and the
+   expansions going through one of them are dropped.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+/* Number of groups kept by the process */
+#define	GROUP_MEMBERS_CACHE_SIZE	128
+
+struct group_members_entry {
+	struct group_members_entry	*prev;
+	struct group_members_entry	*next;
+	char				*dn;
+	char				**members;	/* sorted */
+	uint32_t			count;
+	char				**groups;	/* the group and its nested groups */
+	uint32_t			groups_count;
+};
+
+/* Most recently used first */
+static struct group_members_entry	*group_cache = NULL;
+static uint32_t				group_cache_count = 0;
+static uint64_t				group_cache_usn = 0;
+static time_t				group_cache_checked = 0;
+
+
+static void group_members_cache_remove(struct group_members_entry *entry)
+{
+	DLIST_REMOVE(group_cache, entry);
+	talloc_free(entry);
+	group_cache_count--;
+}
+
+
+static bool group_members_entry_has_group(struct group_members_entry *entry, const char *dn)
+{
+	uint32_t	i;
+
+	for (i = 0; i < entry->groups_count; i++) {
+		if (!strcasecmp(entry->groups[i], dn)) return true;
+	}
+
+	return false;
+}
+
+
+/**
+   \details Drop the expansions going through a group changed since
+   the last check
+ */
+static void group_members_cache_refresh(struct ldb_context *samdb_ctx)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct ldb_result		*res = NULL;
+	struct group_members_entry	*entry, *next;
+	const char * const		attrs[] = { "uSNChanged", NULL };
+	const char			*dn;
+	uint64_t			usn, max_usn;
+	time_t				now;
+	uint32_t			i;
+	int				ret;
+
+	if (!group_cache) return;
+
+	now = time(NULL);
+	if (now == group_cache_checked) return;
+	group_cache_checked = now;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	ret = ldb_search(samdb_ctx, mem_ctx, &res, ldb_get_default_basedn(samdb_ctx),
+			 LDB_SCOPE_SUBTREE, attrs, "(&(objectClass=group)(uSNChanged>=%llu))",
+			 (unsigned long long) (group_cache_usn + 1));
+	if (ret != LDB_SUCCESS) {
+		/* We cannot tell what changed */
+		while (group_cache) {
+			group_members_cache_remove(group_cache);
+		}
+		talloc_free(mem_ctx);
+		return;
+	}
+
+	max_usn = group_cache_usn;
+	for (i = 0; i < res->count; i++) {
+		usn = ldb_msg_find_attr_as_uint64(res->msgs[i], "uSNChanged", 0);
+		max_usn = MAX(max_usn, usn);
+
+		dn = ldb_dn_get_linearized(res->msgs[i]->dn);
+		for (entry = group_cache; entry; entry = next) {
+			next = entry->next;
+			if (group_members_entry_has_group(entry, dn)) {
+				OC_DEBUG(5, "[group_members] %s changed, dropping %s", dn, entry->dn);
+				group_members_cache_remove(entry);
+			}
+		}
+	}
+	group_cache_usn = max_usn;
+
+	talloc_free(mem_ctx);
+}
+
+
+static bool group_members_is_group(struct ldb_message *msg)
+{
+	struct ldb_message_element	*el;
+	unsigned int			i;
+
+	el = ldb_msg_find_element(msg, "objectClass");
+	if (!el) return false;
+
+	for (i = 0; i < el->num_values; i++) {
+		if (!strcasecmp((const char *)el->values[i].data, "group")) return true;
+	}
+
+	return false;
+}
+
+
+static int group_members_dn_cmp(const void *a, const void *b)
+{
+	return strcasecmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+/**
+   \details Expand a group and its nested groups in SAMDB
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if group_dn
+   is not a group, otherwise MAPI error
+ */
+static enum MAPISTATUS group_members_expand(TALLOC_CTX *mem_ctx, struct ldb_context *samdb_ctx,
+					    const char *group_dn, struct group_members_entry **entryp,
+					    uint64_t *usnp)
+{
+	TALLOC_CTX			*local_mem_ctx;
+	struct group_members_entry	*entry;
+	struct ldb_result		*res = NULL;
+	struct ldb_dn			*dn;
+	const char * const		attrs[] = { "objectClass", "uSNChanged", NULL };
+	const char			*member_dn;
+	uint64_t			usn = 0;
+	uint32_t			next_group;
+	uint32_t			i, j;
+	int				ret;
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	dn = ldb_dn_new(local_mem_ctx, samdb_ctx, group_dn);
+	OPENCHANGE_RETVAL_IF(!dn || !ldb_dn_validate(dn), MAPI_E_NOT_FOUND, local_mem_ctx);
+
+	ret = ldb_search(samdb_ctx, local_mem_ctx, &res, dn, LDB_SCOPE_BASE, attrs, "(objectClass=group)");
+	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS || res->count != 1, MAPI_E_NOT_FOUND, local_mem_ctx);
+	usn = ldb_msg_find_attr_as_uint64(res->msgs[0], "uSNChanged", 0);
+
+	entry = talloc_zero(mem_ctx, struct group_members_entry);
+	OPENCHANGE_RETVAL_IF(!entry, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	entry->dn = talloc_strdup(entry, group_dn);
+	entry->groups = talloc_array(entry, char *, 1);
+	entry->members = talloc_array(entry, char *, 0);
+	if (!entry->dn || !entry->groups || !entry->members) {
+		talloc_free(entry);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	}
+	entry->groups[0] = entry->dn;
+	entry->groups_count = 1;
+
+	/* Groups are walked breadth first, each one only once so that
+	 * cycles terminate */
+	for (next_group = 0; next_group < entry->groups_count; next_group++) {
+		ret = ldb_search(samdb_ctx, local_mem_ctx, &res, ldb_get_default_basedn(samdb_ctx),
+				 LDB_SCOPE_SUBTREE, attrs, "(memberOf=%s)",
+				 ldb_binary_encode_string(local_mem_ctx, entry->groups[next_group]));
+		if (ret != LDB_SUCCESS) {
+			talloc_free(entry);
+			OPENCHANGE_RETVAL_ERR(MAPI_E_CALL_FAILED, local_mem_ctx);
+		}
+
+		for (i = 0; i < res->count; i++) {
+			member_dn = ldb_dn_get_linearized(res->msgs[i]->dn);
+			if (group_members_is_group(res->msgs[i])) {
+				usn = MAX(usn, ldb_msg_find_attr_as_uint64(res->msgs[i], "uSNChanged", 0));
+				if (group_members_entry_has_group(entry, member_dn)) continue;
+
+				entry->groups = talloc_realloc(entry, entry->groups, char *, entry->groups_count + 1);
+				if (!entry->groups) goto nomem;
+				entry->groups[entry->groups_count] = talloc_strdup(entry, member_dn);
+				if (!entry->groups[entry->groups_count]) goto nomem;
+				entry->groups_count++;
+			} else {
+				entry->members = talloc_realloc(entry, entry->members, char *, entry->count + 1);
+				if (!entry->members) goto nomem;
+				entry->members[entry->count] = talloc_strdup(entry, member_dn);
+				if (!entry->members[entry->count]) goto nomem;
+				entry->count++;
+			}
+		}
+		talloc_free(res);
+	}
+
+	/* A member of several nested groups is listed once */
+	if (entry->count) {
+		qsort(entry->members, entry->count, sizeof (char *), group_members_dn_cmp);
+		for (i = 1, j = 1; i < entry->count; i++) {
+			if (strcasecmp(entry->members[i], entry->members[j - 1])) {
+				entry->members[j++] = entry->members[i];
+			} else {
+				talloc_free(entry->members[i]);
+			}
+		}
+		entry->count = j;
+	}
+
+	talloc_free(local_mem_ctx);
+	*entryp = entry;
+	*usnp = usn;
+
+	return MAPI_E_SUCCESS;
+
+nomem:
+	talloc_free(entry);
+	OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+}
+
+
+/**
+   \details Retrieve the members of a group, including the members of
+   the groups nested in it
+
+   \param mem_ctx pointer to the memory context the members are
+   allocated with
+   \param samdb_ctx pointer to the SAMDB context
+   \param group_dn the distinguished name of the group
+   \param countp pointer to the number of members to return
+   \param membersp pointer on pointer to the distinguished names of
+   the members to return, sorted. Nested groups are not listed.
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if group_dn
+   is not a group, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_group_members(TALLOC_CTX *mem_ctx, struct ldb_context *samdb_ctx,
+						 const char *group_dn, uint32_t *countp, char ***membersp)
+{
+	enum MAPISTATUS			retval;
+	struct group_members_entry	*entry;
+	char				**members;
+	uint64_t			usn;
+	uint32_t			i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!samdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!group_dn || !countp || !membersp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	group_members_cache_refresh(samdb_ctx);
+
+	for (entry = group_cache; entry; entry = entry->next) {
+		if (!strcasecmp(entry->dn, group_dn)) break;
+	}
+
+	if (entry) {
+		DLIST_PROMOTE(group_cache, entry);
+	} else {
+		retval = group_members_expand(NULL, samdb_ctx, group_dn, &entry, &usn);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+		if (!group_cache) {
+			group_cache_usn = usn;
+			group_cache_checked = time(NULL);
+		}
+		if (group_cache_count >= GROUP_MEMBERS_CACHE_SIZE) {
+			group_members_cache_remove(DLIST_TAIL(group_cache));
+		}
+		DLIST_ADD(group_cache, entry);
+		group_cache_count++;
+	}
+
+	members = talloc_array(mem_ctx, char *, entry->count);
+	OPENCHANGE_RETVAL_IF(!members, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	for (i = 0; i < entry->count; i++) {
+		members[i] = talloc_strdup(members, entry->members[i]);
+		OPENCHANGE_RETVAL_IF(!members[i], MAPI_E_NOT_ENOUGH_MEMORY, members);
+	}
+
+	*countp = entry->count;
+	*membersp = members;
+
+	return MAPI_E_SUCCESS;
+}
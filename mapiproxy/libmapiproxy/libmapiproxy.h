@@ -120,13 +120,127 @@ struct mapi_handles {
 	void		       	*private_data;
 	struct mapi_handles	*prev;
 	struct mapi_handles	*next;
+	struct mapi_handles	*parent;	/* NULL for root handles */
+	struct mapi_handles	*children;
+	struct mapi_handles	*prev_sibling;
+	struct mapi_handles	*next_sibling;
 };
 
 
 struct mapi_handles_context {
-	TDB_CONTEXT	       	*tdb_ctx;
+	TDB_CONTEXT	       	*tdb_ctx;	/* optional debug mirror */
 	uint32_t		last_handle;
 	struct mapi_handles    	*handles;
+	struct mapi_handles	**slots;	/* indexed by handle value */
+	uint32_t		slots_size;
+	uint32_t		*free_list;	/* released handle values */
+	uint32_t		free_count;
+	uint32_t		free_size;
+	struct mapi_handles	*free_records;	/* released records, cleared */
+	uint32_t		free_records_count;
+	uint32_t		count;		/* live records */
+};
+
+
+enum mapiproxy_restriction_op {
+	MAPIPROXY_RESTRICTION_TRUE,
+	MAPIPROXY_RESTRICTION_FALSE,
+	MAPIPROXY_RESTRICTION_AND,
+	MAPIPROXY_RESTRICTION_OR,
+	MAPIPROXY_RESTRICTION_NOT,
+	MAPIPROXY_RESTRICTION_COMPARE,
+	MAPIPROXY_RESTRICTION_CONTENT,
+	MAPIPROXY_RESTRICTION_BITMASK,
+	MAPIPROXY_RESTRICTION_SIZE,
+	MAPIPROXY_RESTRICTION_EXIST,
+	MAPIPROXY_RESTRICTION_COMPARE_PROPS
+};
+
+
+struct mapiproxy_restriction_value {
+	uint16_t		type;	/* PT_I2/LONG/BOOLEAN/I8, PT_DOUBLE, PT_UNICODE or PT_BINARY */
+	union {
+		uint64_t	i;
+		double		dbl;
+		const char	*str;
+		struct {
+			uint32_t	cb;
+			const uint8_t	*lpb;
+		} bin;
+	} u;
+};
+
+
+struct mapiproxy_restriction_instr {
+	enum mapiproxy_restriction_op		op;
+	uint32_t				length;	/* instructions in this subtree */
+	uint8_t					relop;	/* CompareRelop or relMBR */
+	uint32_t				fuzzy;
+	enum MAPITAGS				proptag;
+	enum MAPITAGS				proptag2;
+	uint32_t				mask;
+	uint32_t				size;
+	struct mapiproxy_restriction_value	value;
+};
+
+
+struct mapiproxy_restriction {
+	uint32_t				count;
+	struct mapiproxy_restriction_instr	*instrs;	/* prefix order */
+};
+
+
+typedef enum MAPISTATUS (*mapiproxy_restriction_get_property_t)(void *, enum MAPITAGS, void **);
+
+
+struct mapiproxy_shard_point {
+	uint32_t		hash;
+	uint32_t		node;	/* index in nodes */
+};
+
+
+struct mapiproxy_shard_ring {
+	uint32_t			node_count;
+	char				**nodes;
+	char				*local;	/* name of this node */
+	uint32_t			count;
+	struct mapiproxy_shard_point	*points;	/* sorted by hash */
+};
+
+
+struct mapiproxy_rule {
+	uint64_t			id;
+	uint32_t			sequence;
+	uint32_t			state;
+	struct mapi_SPropValue_array	props;		/* as set by the client, PidTagRuleId included */
+	struct mapiproxy_restriction	*condition;	/* NULL if the condition can not be evaluated */
+	const struct RuleAction		*actions;
+};
+
+
+struct mapiproxy_rules {
+	uint64_t			next_id;
+	uint32_t			count;
+	struct mapiproxy_rule		*rules;		/* sorted by sequence */
+};
+
+
+/* A folder of a hierarchy subtree, see openchangedb_get_folder_tree() */
+struct openchangedb_folder_tree_entry {
+	uint64_t			fid;
+	uint64_t			parent_fid;
+	uint32_t			depth;		/* 0 for the children of the subtree root */
+	bool				mapistore;	/* the subfolders live in a mapistore backend */
+	void				**data;
+	enum MAPISTATUS			*retvals;
+};
+
+/* Message counters of a folder, or a change to apply to them */
+struct openchangedb_message_counts {
+	int64_t				messages;
+	int64_t				fai;
+	int64_t				unread;
+	int64_t				size;		/* sum of PidTagMessageSize */
 };
 
 
@@ -134,6 +248,46 @@ struct mapi_handles_context {
 #define	MAPI_HANDLES_ROOT	"root"
 #define	MAPI_HANDLES_NULL	"null"
 
+/* Folder property the rules of the folder are stored in */
+#define	MAPIPROXY_RULES_PROPTAG		PROP_TAG(PT_BINARY, 0x3fe1)
+#define	MAPIPROXY_RULES_VERSION		1
+
+/* PidTagRuleState flags */
+#define	MAPIPROXY_RULE_ENABLED		0x00000001
+#define	MAPIPROXY_RULE_ERROR		0x00000002
+#define	MAPIPROXY_RULE_ONLY_WHEN_OOF	0x00000004
+#define	MAPIPROXY_RULE_EXIT_LEVEL	0x00000010
+#define	MAPIPROXY_RULE_PARSE_ERROR	0x00000040
+
+/* Runtime statistics shared by the processes, see mapiproxy_stats.c */
+#define	MAPIPROXY_STATS_MAGIC		0x4f43524d
+#define	MAPIPROXY_STATS_VERSION		1
+#define	MAPIPROXY_STATS_VALUES		32
+#define	MAPIPROXY_STATS_MAPISTORE_SIZE	131072
+
+/* Counters and gauges of the statistics file */
+enum mapiproxy_stats_value {
+	MAPIPROXY_STATS_EMSMDB_SESSIONS,	/* gauge */
+	MAPIPROXY_STATS_NSPI_SESSIONS,		/* gauge */
+	MAPIPROXY_STATS_HANDLES,		/* gauge, records of all the handle tables */
+	MAPIPROXY_STATS_EMSMDB_JOBS,		/* gauge, calls waiting for a worker thread */
+	MAPIPROXY_STATS_EMSMDB_NOTIFICATIONS,	/* counter, notifications sent to clients */
+	MAPIPROXY_STATS_NSPI_CALLS,		/* counter */
+	MAPIPROXY_STATS_MAX
+};
+
+/* Layout of the mapiproxy-<pid>.stats file of a process */
+struct mapiproxy_stats {
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			pid;
+	uint32_t			values_count;	/* MAPIPROXY_STATS_VALUES */
+	uint64_t			started;
+	uint64_t			values[MAPIPROXY_STATS_VALUES];
+	/* struct mapistore_shared_stats, see mapistore.h */
+	uint8_t				mapistore[MAPIPROXY_STATS_MAPISTORE_SIZE];
+};
+
 
 /**
    EMSABP server defines
@@ -169,6 +323,7 @@ NTSTATUS mapiproxy_module_pull(struct dcesrv_call_state *, TALLOC_CTX *, void *)
 NTSTATUS mapiproxy_module_ndr_pull(struct dcesrv_call_state *, TALLOC_CTX *, struct ndr_pull *);
 NTSTATUS mapiproxy_module_dispatch(struct dcesrv_call_state *, TALLOC_CTX *, void *, struct mapiproxy *);
 NTSTATUS mapiproxy_module_unbind(struct server_id, uint32_t);
+bool mapiproxy_module_loaded(const char *);
 
 const struct mapiproxy_module *mapiproxy_module_byname(const char *);
 
@@ -181,9 +336,15 @@ bool mapiproxy_server_loaded(const char *);
 
 const struct mapiproxy_module *mapiproxy_server_bystatus(const char *, enum mapiproxy_status);
 const struct mapiproxy_module *mapiproxy_server_byname(const char *);
+const struct mapiproxy_module *mapiproxy_server_byendpoint(const char *);
 
 TDB_CONTEXT *mapiproxy_server_emsabp_tdb_init(struct loadparm_context *);
 void *mapiproxy_server_openchangedb_init(struct loadparm_context *);
+void *mapiproxy_server_openchangedb_user_init(struct loadparm_context *, const char *);
+struct ldb_context *mapiproxy_server_samdb_init(struct loadparm_context *);
+bool mapiproxy_server_lock_enable(void);
+void mapiproxy_server_lock(void);
+bool mapiproxy_server_unlock(void);
 
 /* definitions from dcesrv_mapiproxy_session. c */
 struct mpm_session *mpm_session_new(TALLOC_CTX *, struct server_id, uint32_t);
@@ -199,6 +360,7 @@ struct openchangedb_context;
 
 /* definitions from openchangedb.c */
 enum MAPISTATUS openchangedb_initialize(TALLOC_CTX *, struct loadparm_context *, struct openchangedb_context **oc_ctx);
+enum MAPISTATUS openchangedb_initialize_url(TALLOC_CTX *, struct loadparm_context *, const char *, struct openchangedb_context **);
 enum MAPISTATUS openchangedb_get_new_changeNumber(struct openchangedb_context *, const char *, uint64_t *);
 enum MAPISTATUS openchangedb_get_new_changeNumbers(struct openchangedb_context *, TALLOC_CTX *, const char *, uint64_t, struct UI8Array_r **);
 enum MAPISTATUS openchangedb_get_next_changeNumber(struct openchangedb_context *, const char *, uint64_t *);
@@ -221,7 +383,20 @@ enum MAPISTATUS openchangedb_lookup_folder_property(struct openchangedb_context
 enum MAPISTATUS openchangedb_set_folder_properties(struct openchangedb_context *, const char *, uint64_t, struct SRow *);
 char *          openchangedb_set_folder_property_data(TALLOC_CTX *, struct SPropValue *);
 enum MAPISTATUS openchangedb_get_folder_property(TALLOC_CTX *, struct openchangedb_context *, const char *, uint32_t, uint64_t, void **);
+enum MAPISTATUS openchangedb_get_folder_properties(TALLOC_CTX *, struct openchangedb_context *, const char *, struct SPropTagArray *, uint64_t, void **, enum MAPISTATUS *);
 enum MAPISTATUS openchangedb_get_folder_count(struct openchangedb_context *, const char *, uint64_t, uint32_t *);
+enum MAPISTATUS openchangedb_get_folder_tree(TALLOC_CTX *, struct openchangedb_context *, const char *, uint64_t, uint32_t, struct SPropTagArray *, uint32_t *, struct openchangedb_folder_tree_entry **);
+enum MAPISTATUS openchangedb_get_recursive_folder_count(struct openchangedb_context *, const char *, uint64_t, uint32_t *);
+enum MAPISTATUS openchangedb_set_recursive_folder_count(struct openchangedb_context *, const char *, uint64_t, uint32_t);
+enum MAPISTATUS openchangedb_update_recursive_folder_counts(struct openchangedb_context *, const char *, uint32_t, const uint64_t *, int32_t);
+enum MAPISTATUS openchangedb_clear_recursive_folder_counts(struct openchangedb_context *, const char *, uint32_t, const uint64_t *);
+enum MAPISTATUS openchangedb_get_hierarchy_change_number(struct openchangedb_context *, const char *, uint64_t, uint64_t *);
+enum MAPISTATUS openchangedb_set_hierarchy_change_numbers(struct openchangedb_context *, const char *, uint32_t, const uint64_t *, uint64_t);
+enum MAPISTATUS openchangedb_clear_hierarchy_change_numbers(struct openchangedb_context *, const char *, uint32_t, const uint64_t *);
+enum MAPISTATUS openchangedb_get_message_counts(struct openchangedb_context *, const char *, uint64_t, uint32_t, struct openchangedb_message_counts *);
+enum MAPISTATUS openchangedb_set_message_counts(struct openchangedb_context *, const char *, uint64_t, const struct openchangedb_message_counts *);
+enum MAPISTATUS openchangedb_update_message_counts(struct openchangedb_context *, const char *, uint64_t, const struct openchangedb_message_counts *);
+enum MAPISTATUS openchangedb_clear_message_counts(struct openchangedb_context *, const char *, uint32_t, const uint64_t *);
 enum MAPISTATUS openchangedb_get_message_count(struct openchangedb_context *, const char *, uint64_t, uint32_t *, bool);
 enum MAPISTATUS openchangedb_get_system_idx(struct openchangedb_context *, const char *, uint64_t, int *);
 enum MAPISTATUS openchangedb_set_system_idx(struct openchangedb_context*, const char *, uint64_t, int);
@@ -262,6 +437,7 @@ const char *openchangedb_property_get_attribute(uint32_t);
 
 /* definitions from mapi_handles.c */
 struct mapi_handles_context *mapi_handles_init(TALLOC_CTX *);
+enum MAPISTATUS	mapi_handles_set_tdb_mirror(struct mapi_handles_context *, bool);
 enum MAPISTATUS	mapi_handles_release(struct mapi_handles_context *);
 enum MAPISTATUS mapi_handles_search(struct mapi_handles_context *, uint32_t, struct mapi_handles **);
 enum MAPISTATUS mapi_handles_add(struct mapi_handles_context *, uint32_t, struct mapi_handles **);
@@ -275,6 +451,36 @@ enum MAPISTATUS mapi_handles_set_systemfolder(struct mapi_handles *, int);
 enum MAPISTATUS entryid_set_AB_EntryID(TALLOC_CTX *, const char *, struct SBinary_short *);
 enum MAPISTATUS entryid_set_folder_EntryID(TALLOC_CTX *, struct GUID *, struct GUID *, uint16_t, uint64_t, struct Binary_r **);
 
+/* definitions from restriction.c */
+enum MAPISTATUS mapiproxy_restriction_compile(TALLOC_CTX *, const struct mapi_SRestriction *, struct mapiproxy_restriction **);
+bool mapiproxy_restriction_match(const struct mapiproxy_restriction *, mapiproxy_restriction_get_property_t, void *);
+enum MAPISTATUS mapiproxy_restriction_add_proptags(TALLOC_CTX *, const struct mapiproxy_restriction *, struct SPropTagArray *);
+
+/* definitions from rules.c */
+enum MAPISTATUS mapiproxy_rules_pack(TALLOC_CTX *, const struct mapiproxy_rules *, DATA_BLOB *);
+enum MAPISTATUS mapiproxy_rules_unpack(TALLOC_CTX *, const DATA_BLOB *, struct mapiproxy_rules **);
+enum MAPISTATUS mapiproxy_rules_load(TALLOC_CTX *, struct openchangedb_context *, const char *, uint64_t, struct mapiproxy_rules **);
+enum MAPISTATUS mapiproxy_rules_save(struct openchangedb_context *, const char *, uint64_t, const struct mapiproxy_rules *);
+enum MAPISTATUS mapiproxy_rules_modify(struct mapiproxy_rules *, const struct ModifyRules_req *);
+enum MAPISTATUS mapiproxy_rule_get_property(TALLOC_CTX *, const struct mapiproxy_rule *, enum MAPITAGS, void **);
+enum MAPISTATUS mapiproxy_rules_get_proptags(TALLOC_CTX *, const struct mapiproxy_rules *, struct SPropTagArray **);
+enum MAPISTATUS mapiproxy_rules_evaluate(TALLOC_CTX *, const struct mapiproxy_rules *, mapiproxy_restriction_get_property_t, void *, const struct mapiproxy_rule ***, uint32_t *);
+
+/* definitions from shard.c */
+uint32_t mapiproxy_shard_hash(const char *);
+enum MAPISTATUS mapiproxy_shard_ring_init(TALLOC_CTX *, const char * const *, uint32_t, struct mapiproxy_shard_ring **);
+const char *mapiproxy_shard_ring_lookup(const struct mapiproxy_shard_ring *, const char *);
+const struct mapiproxy_shard_ring *mapiproxy_shard_ring_get(struct loadparm_context *);
+const char *mapiproxy_shard_redirect(struct loadparm_context *, const char *);
+
+/* definitions from group_members.c */
+enum MAPISTATUS mapiproxy_group_members(TALLOC_CTX *, struct ldb_context *, const char *, uint32_t *, char ***);
+
+/* definitions from mapiproxy_stats.c */
+bool mapiproxy_stats_init(struct loadparm_context *);
+void mapiproxy_stats_add(enum mapiproxy_stats_value, int64_t);
+void *mapiproxy_stats_mapistore_area(size_t *);
+
 /* definitions from modules.c */
 typedef NTSTATUS (*openchange_plugin_init_fn) (void);
 openchange_plugin_init_fn *load_openchange_plugins(TALLOC_CTX *mem_ctx, const char *path);
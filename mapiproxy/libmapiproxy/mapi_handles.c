@@ -30,6 +30,20 @@
 #include "libmapi/libmapi_private.h"
 #include "libmapiproxy.h"
 
+#define	MAPI_HANDLES_INITIAL_SLOTS	64
+
+/* Released records kept for reuse */
+#define	MAPI_HANDLES_FREE_RECORDS	64
+
+static int mapi_handles_context_destructor(struct mapi_handles_context *handles_ctx)
+{
+	/* The records still registered go along with the context */
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, -(int64_t) handles_ctx->count);
+
+	return 0;
+}
+
+
 /**
    \details Initialize MAPI handles context
 
@@ -45,11 +59,24 @@ _PUBLIC_ struct mapi_handles_context *mapi_handles_init(TALLOC_CTX *mem_ctx)
 	handles_ctx = talloc_zero(mem_ctx, struct mapi_handles_context);
 	if (!handles_ctx) return NULL;
 
-	/* Step 2. Initialize the TDB context */
-	handles_ctx->tdb_ctx = tdb_open(NULL, 0, TDB_INTERNAL, O_RDWR|O_CREAT, 0600);
+	/* Step 2. The TDB mirror is only opened on demand */
+	handles_ctx->tdb_ctx = NULL;
 
-	/* Step 3. Initialize the handles list */
+	/* Step 3. Initialize the handles list and slot table */
 	handles_ctx->handles = NULL;
+	handles_ctx->slots = talloc_zero_array(handles_ctx, struct mapi_handles *, MAPI_HANDLES_INITIAL_SLOTS);
+	if (!handles_ctx->slots) {
+		talloc_free(handles_ctx);
+		return NULL;
+	}
+	handles_ctx->slots_size = MAPI_HANDLES_INITIAL_SLOTS;
+	handles_ctx->free_list = NULL;
+	handles_ctx->free_count = 0;
+	handles_ctx->free_size = 0;
+	handles_ctx->free_records = NULL;
+	handles_ctx->free_records_count = 0;
+	handles_ctx->count = 0;
+	talloc_set_destructor(handles_ctx, mapi_handles_context_destructor);
 
 	/* Step 4. Set last_handle to the first valid value */
 	handles_ctx->last_handle = 1;
@@ -58,9 +85,47 @@ _PUBLIC_ struct mapi_handles_context *mapi_handles_init(TALLOC_CTX *mem_ctx)
 }
 
 
+/**
+   \details Enable or disable the TDB mirror of the handles table.
+
+   The TDB database is not used for any lookup, it only reflects the
+   handles hierarchy so it can be inspected when debugging.
+
+   \param handles_ctx pointer to the MAPI handles context
+   \param enable whether the mirror should be maintained or not
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapi_handles_set_tdb_mirror(struct mapi_handles_context *handles_ctx, bool enable)
+{
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+
+	if (enable == false) {
+		if (handles_ctx->tdb_ctx) {
+			tdb_close(handles_ctx->tdb_ctx);
+			handles_ctx->tdb_ctx = NULL;
+		}
+		return MAPI_E_SUCCESS;
+	}
+
+	if (handles_ctx->tdb_ctx) return MAPI_E_SUCCESS;
+
+	/* Only handles created from now on are mirrored */
+	handles_ctx->tdb_ctx = tdb_open(NULL, 0, TDB_INTERNAL, O_RDWR|O_CREAT, 0600);
+	OPENCHANGE_RETVAL_IF(!handles_ctx->tdb_ctx, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Release MAPI handles context
 
+   All the handles are owned by the context and are freed along with
+   it in a single pass, most recently created first, so that children
+   go before their parents.
+
    \param handles_ctx pointer to the MAPI handles context
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
@@ -70,7 +135,10 @@ _PUBLIC_ enum MAPISTATUS mapi_handles_release(struct mapi_handles_context *handl
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
 
-	tdb_close(handles_ctx->tdb_ctx);
+	if (handles_ctx->tdb_ctx) {
+		tdb_close(handles_ctx->tdb_ctx);
+		handles_ctx->tdb_ctx = NULL;
+	}
 	talloc_free(handles_ctx);
 
 	return MAPI_E_SUCCESS;
@@ -78,7 +146,7 @@ _PUBLIC_ enum MAPISTATUS mapi_handles_release(struct mapi_handles_context *handl
 
 
 /**
-   \details Search for a record in the TDB database
+   \details Search for a MAPI handle
 
    \param handles_ctx pointer to the MAPI handles context
    \param handle MAPI handle to lookup
@@ -90,168 +158,238 @@ _PUBLIC_ enum MAPISTATUS mapi_handles_release(struct mapi_handles_context *handl
 _PUBLIC_ enum MAPISTATUS mapi_handles_search(struct mapi_handles_context *handles_ctx,
 					     uint32_t handle, struct mapi_handles **rec)
 {
-	TALLOC_CTX		*mem_ctx;
-	TDB_DATA		key;
-	TDB_DATA		dbuf;
-	struct mapi_handles	*el;
-
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!handles_ctx->tdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!handles_ctx->slots, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(handle == MAPI_HANDLES_RESERVED, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!rec, MAPI_E_INVALID_PARAMETER, NULL);
 
-	mem_ctx = talloc_named(NULL, 0, "mapi_handles_search");
+	/* Handle values are indexes within the slot table, free'd
+	 * handles have a NULL slot */
+	OPENCHANGE_RETVAL_IF(handle >= handles_ctx->slots_size, MAPI_E_NOT_FOUND, NULL);
+	OPENCHANGE_RETVAL_IF(!handles_ctx->slots[handle], MAPI_E_NOT_FOUND, NULL);
+
+	*rec = handles_ctx->slots[handle];
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Store a handle record within the TDB mirror
+
+   \param handles_ctx pointer to the MAPI handles context
+   \param handle handle key value
+   \param container_handle the container handle, 0 for root handles
+
+   \note A no-op when the mirror is disabled
+ */
+static void mapi_handles_tdb_store(struct mapi_handles_context *handles_ctx,
+				   uint32_t handle, uint32_t container_handle)
+{
+	TALLOC_CTX	*mem_ctx;
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	int		ret;
+
+	if (!handles_ctx->tdb_ctx) return;
+
+	mem_ctx = talloc_named(NULL, 0, "mapi_handles_tdb_store");
 
-	/* Step 1. Search for the handle within TDB database */
 	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", handle);
 	key.dsize = strlen((const char *)key.dptr);
 
-	dbuf = tdb_fetch(handles_ctx->tdb_ctx, key);
-	talloc_free(key.dptr);
-	OPENCHANGE_RETVAL_IF(!dbuf.dptr, MAPI_E_NOT_FOUND, mem_ctx);
-	OPENCHANGE_RETVAL_IF(!dbuf.dsize, MAPI_E_NOT_FOUND, mem_ctx);
-
-	talloc_free(mem_ctx);
-	/* Ensure this is not a free'd record */
-	if (dbuf.dsize == (sizeof(MAPI_HANDLES_NULL) - 1) && !strncmp((char *)dbuf.dptr, MAPI_HANDLES_NULL, dbuf.dsize)) {
-		free(dbuf.dptr);
-		return MAPI_E_NOT_FOUND;
+	if (container_handle) {
+		dbuf.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", container_handle);
+		dbuf.dsize = strlen((const char *)dbuf.dptr);
+	} else {
+		dbuf.dptr = (unsigned char *) MAPI_HANDLES_ROOT;
+		dbuf.dsize = strlen(MAPI_HANDLES_ROOT);
 	}
-	free(dbuf.dptr);
 
-	/* Step 2. Return the record within the double chained list */
-	for (el = handles_ctx->handles; el; el = el->next) {
-		if (el->handle == handle) {
-			*rec = el;
-			return MAPI_E_SUCCESS;
-		}
+	ret = tdb_store(handles_ctx->tdb_ctx, key, dbuf, TDB_REPLACE);
+	if (ret == -1) {
+		OC_DEBUG(3, "Unable to mirror 0x%x record: %s",
+			  handle, tdb_errorstr(handles_ctx->tdb_ctx));
 	}
-
-	return MAPI_E_CORRUPT_STORE;
+	talloc_free(mem_ctx);
 }
 
 
 /**
-   \details Set a TDB record data as null meaning it can be reused in
-   the future.
+   \details Set a TDB mirror record data as null meaning the handle
+   was released.
 
    \param handles_ctx pointer to the MAPI handles context
    \param handle handle key value to free
 
-   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+   \note A no-op when the mirror is disabled
  */
-static enum MAPISTATUS mapi_handles_tdb_free(struct mapi_handles_context *handles_ctx,
-					     uint32_t handle)
+static void mapi_handles_tdb_free(struct mapi_handles_context *handles_ctx,
+				  uint32_t handle)
 {
 	TALLOC_CTX		*mem_ctx;
 	TDB_DATA		key;
 	TDB_DATA		dbuf;
 	int			ret;
 
-	/* Sanity checks */
-	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!handles_ctx->tdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(handle == MAPI_HANDLES_RESERVED, MAPI_E_INVALID_PARAMETER, NULL);
+	if (!handles_ctx->tdb_ctx) return;
 
 	mem_ctx = talloc_named(NULL, 0, "mapi_handles_tdb_free");
 	
 	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", handle);
 	key.dsize = strlen((const char *)key.dptr);
 
-	/* Step 1. Makes sure the record exists */
-	ret = tdb_exists(handles_ctx->tdb_ctx, key);
-	OPENCHANGE_RETVAL_IF(!ret, MAPI_E_NOT_FOUND, mem_ctx);
-
-	/* Step 2. Update existing record */
 	dbuf.dptr = (unsigned char *)MAPI_HANDLES_NULL;
 	dbuf.dsize = sizeof(MAPI_HANDLES_NULL) - 1;
 
-	ret = tdb_store(handles_ctx->tdb_ctx, key, dbuf, TDB_MODIFY);
-	talloc_free(mem_ctx);
+	ret = tdb_store(handles_ctx->tdb_ctx, key, dbuf, TDB_REPLACE);
 	if (ret == -1) {
-		OC_DEBUG(3, "Unable to create 0x%x record: %s\n",
+		OC_DEBUG(3, "Unable to mirror release of 0x%x record: %s",
 			  handle, tdb_errorstr(handles_ctx->tdb_ctx));
-		return MAPI_E_CORRUPT_STORE;
 	}
-
-	return MAPI_E_SUCCESS;
+	talloc_free(mem_ctx);
 }
 
 
 /**
-   \details Update a TDB record
+   \details Pick the handle value for a new record: reuse the most
+   recently released one if any, otherwise grow the slot table.
 
-   
+   \param handles_ctx pointer to the MAPI handles context
+   \param handle pointer to the handle value the function returns
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
-static enum MAPISTATUS mapi_handles_tdb_update(struct mapi_handles_context *handles_ctx,
-					       uint32_t handle, uint32_t container_handle)
+static enum MAPISTATUS mapi_handles_slot_alloc(struct mapi_handles_context *handles_ctx,
+					       uint32_t *handle)
 {
-	TALLOC_CTX	*mem_ctx;
-	TDB_DATA	key;
-	TDB_DATA	dbuf;
-	int		ret;
+	struct mapi_handles	**slots;
+	uint32_t		slots_size;
 
-	/* Sanity checks */
-	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!handles_ctx->tdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!handle, MAPI_E_INVALID_PARAMETER, NULL);
+	if (handles_ctx->free_count) {
+		handles_ctx->free_count -= 1;
+		*handle = handles_ctx->free_list[handles_ctx->free_count];
+		OC_DEBUG(5, "We have found free record 0x%x", *handle);
+		return MAPI_E_SUCCESS;
+	}
 
-	mem_ctx = talloc_named(NULL, 0, "mapi_handles_tdb_update");
+	OPENCHANGE_RETVAL_IF(handles_ctx->last_handle == MAPI_HANDLES_RESERVED, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
 
-	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", handle);
-	key.dsize = strlen((const char *)key.dptr);
+	if (handles_ctx->last_handle >= handles_ctx->slots_size) {
+		slots_size = handles_ctx->slots_size * 2;
+		if (slots_size <= handles_ctx->last_handle || slots_size >= MAPI_HANDLES_RESERVED) {
+			slots_size = MAPI_HANDLES_RESERVED;
+		}
+		slots = talloc_realloc(handles_ctx, handles_ctx->slots, struct mapi_handles *, slots_size);
+		OPENCHANGE_RETVAL_IF(!slots, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+		memset(slots + handles_ctx->slots_size, 0,
+		       (slots_size - handles_ctx->slots_size) * sizeof (struct mapi_handles *));
+		handles_ctx->slots = slots;
+		handles_ctx->slots_size = slots_size;
+	}
 
-	/* Step 1. Makes sure the record exists */
-	ret = tdb_exists(handles_ctx->tdb_ctx, key);
-	OPENCHANGE_RETVAL_IF(!ret, MAPI_E_NOT_FOUND, mem_ctx);
+	*handle = handles_ctx->last_handle;
+	handles_ctx->last_handle += 1;
 
-	/* Step 2. Update record */
-	dbuf.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", container_handle);
-	dbuf.dsize = strlen((const char *)dbuf.dptr);
+	return MAPI_E_SUCCESS;
+}
 
-	ret = tdb_store(handles_ctx->tdb_ctx, key, dbuf, TDB_MODIFY);
-	talloc_free(mem_ctx);
-	if (ret == -1) {
-		OC_DEBUG(3, "Unable to update 0x%x record: %s\n",
-			  handle, tdb_errorstr(handles_ctx->tdb_ctx));
 
-		return MAPI_E_CORRUPT_STORE;
+/**
+   \details Push a released handle value on the free list
+
+   \param handles_ctx pointer to the MAPI handles context
+   \param handle the released handle value
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS mapi_handles_slot_free(struct mapi_handles_context *handles_ctx,
+					      uint32_t handle)
+{
+	uint32_t	*free_list;
+	uint32_t	free_size;
+
+	handles_ctx->slots[handle] = NULL;
+
+	if (handles_ctx->free_count == handles_ctx->free_size) {
+		free_size = handles_ctx->free_size ? handles_ctx->free_size * 2 : MAPI_HANDLES_INITIAL_SLOTS;
+		free_list = talloc_realloc(handles_ctx, handles_ctx->free_list, uint32_t, free_size);
+		/* Losing track of the value only prevents its reuse */
+		OPENCHANGE_RETVAL_IF(!free_list, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+		handles_ctx->free_list = free_list;
+		handles_ctx->free_size = free_size;
 	}
+	handles_ctx->free_list[handles_ctx->free_count] = handle;
+	handles_ctx->free_count += 1;
 
 	return MAPI_E_SUCCESS;
 }
 
 
 /**
-   \details Traverse TDB database and search for the first record
-   which dbuf value is "null" string.
- 
-   \param tdb_ctx pointer to the TDB context
-   \param key the current TDB key
-   \param dbuf the current TDB value
-   \param state pointer on private data
-
-   \return 1 when a free record is found, otherwise 0
-*/
-static int mapi_handles_traverse_null(TDB_CONTEXT *tdb_ctx,
-				      TDB_DATA key, TDB_DATA dbuf,
-				      void *state)
+   \details Link a handle record to the children of its parent
+
+   \param parent the parent record
+   \param el the child record
+ */
+static void mapi_handles_link(struct mapi_handles *parent, struct mapi_handles *el)
 {
-	TALLOC_CTX	*mem_ctx;
-	uint32_t	*handle = (uint32_t *) state;
-	char		*handle_str = NULL;
+	el->parent = parent;
+	el->prev_sibling = NULL;
+	el->next_sibling = parent->children;
+	if (parent->children) {
+		parent->children->prev_sibling = el;
+	}
+	parent->children = el;
+}
+
+
+/**
+   \details Remove a handle record from the children of its parent
+
+   \param el the child record
+ */
+static void mapi_handles_unlink(struct mapi_handles *el)
+{
+	if (!el->parent) return;
 
-	if (dbuf.dptr && (dbuf.dsize == sizeof(MAPI_HANDLES_NULL) - 1) && strncmp((const char *)dbuf.dptr, MAPI_HANDLES_NULL, dbuf.dsize) == 0) {
-		mem_ctx = talloc_named(NULL, 0, "mapi_handles_traverse_null");
-		handle_str = talloc_strndup(mem_ctx, (char *)key.dptr, key.dsize);
-		*handle = strtol((const char *) handle_str, NULL, 16);
-		talloc_free(mem_ctx);
+	if (el->prev_sibling) {
+		el->prev_sibling->next_sibling = el->next_sibling;
+	} else {
+		el->parent->children = el->next_sibling;
+	}
+	if (el->next_sibling) {
+		el->next_sibling->prev_sibling = el->prev_sibling;
+	}
+	el->parent = NULL;
+	el->prev_sibling = NULL;
+	el->next_sibling = NULL;
+}
+
+
+/**
+   \details Release a handle record. Its private data is freed and the
+   record kept for the next handle, up to MAPI_HANDLES_FREE_RECORDS
+   records.
 
-		return 1;
+   \param handles_ctx pointer to the MAPI handles context
+   \param el the record to release, unlinked from the list and the
+   slot table
+ */
+static void mapi_handles_record_free(struct mapi_handles_context *handles_ctx,
+				     struct mapi_handles *el)
+{
+	if (handles_ctx->free_records_count >= MAPI_HANDLES_FREE_RECORDS) {
+		talloc_free(el);
+		return;
 	}
 
-	return 0;
+	talloc_free_children(el);
+	memset(el, 0, sizeof (struct mapi_handles));
+	el->next = handles_ctx->free_records;
+	handles_ctx->free_records = el;
+	handles_ctx->free_records_count++;
 }
 
 
@@ -269,84 +407,50 @@ static int mapi_handles_traverse_null(TDB_CONTEXT *tdb_ctx,
 _PUBLIC_ enum MAPISTATUS mapi_handles_add(struct mapi_handles_context *handles_ctx,
 					  uint32_t container_handle, struct mapi_handles **rec)
 {
-	TALLOC_CTX		*mem_ctx;
 	enum MAPISTATUS		retval;
-	TDB_DATA		key;
-	TDB_DATA		dbuf;
 	uint32_t		handle = 0;
 	struct mapi_handles	*el;
-	int			ret;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!handles_ctx->tdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(handle == MAPI_HANDLES_RESERVED, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles_ctx->slots, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(!rec, MAPI_E_INVALID_PARAMETER, NULL);
 
-	mem_ctx = talloc_named(NULL, 0, "mapi_handles_add");
-
-	/* Step 1. Seek the TDB database for the first free record */
-	ret = tdb_traverse(handles_ctx->tdb_ctx, mapi_handles_traverse_null, (void *)&handle);
-	if (ret > -1 && handle > 0) {
-		OC_DEBUG(5, "We have found free record 0x%x", handle);
-		retval = mapi_handles_tdb_update(handles_ctx, handle, container_handle);
-		OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
-		
-		el = talloc_zero((TALLOC_CTX *)handles_ctx, struct mapi_handles);
-		if (!el) {
-			mapi_handles_tdb_free(handles_ctx, handle);
-			talloc_free(mem_ctx);
-			return MAPI_E_NOT_ENOUGH_RESOURCES;
-		}
-
-		el->handle = handle;
-		el->parent_handle = container_handle;
-		el->private_data = NULL;
-		*rec = el;
-		DLIST_ADD_END(handles_ctx->handles, el, struct mapi_handles *);
-
-		talloc_free(mem_ctx);
-
-		return MAPI_E_SUCCESS;
-	}
-
-	/* Step 2. If no record is available, create a new one */
-	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", handles_ctx->last_handle);
-	key.dsize = strlen((const char *)key.dptr);
-
-	if (container_handle) {
-		dbuf.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", container_handle);
-		dbuf.dsize = strlen((const char *)dbuf.dptr);
+	/* Reuse a released record, they are cleared already */
+	if (handles_ctx->free_records) {
+		el = handles_ctx->free_records;
+		handles_ctx->free_records = el->next;
+		handles_ctx->free_records_count--;
+		el->next = NULL;
 	} else {
-		dbuf.dptr = (unsigned char *) MAPI_HANDLES_ROOT;
-		dbuf.dsize = strlen(MAPI_HANDLES_ROOT);
-	}
-
-	ret = tdb_store(handles_ctx->tdb_ctx, key, dbuf, TDB_INSERT);
-	if (ret == -1) {
-		OC_DEBUG(3, "Unable to create 0x%x record: %s",
-			  handles_ctx->last_handle, tdb_errorstr(handles_ctx->tdb_ctx));
-		talloc_free(mem_ctx);
-
-		return MAPI_E_CORRUPT_STORE;
+		el = talloc_zero((TALLOC_CTX *)handles_ctx, struct mapi_handles);
+		OPENCHANGE_RETVAL_IF(!el, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
 	}
 
-	el = talloc_zero((TALLOC_CTX *)handles_ctx, struct mapi_handles);
-	if (!el) {
-		mapi_handles_tdb_free(handles_ctx, handles_ctx->last_handle);
-		talloc_free(mem_ctx);
-		return MAPI_E_NOT_ENOUGH_RESOURCES;
+	/* Step 1. Pick a free slot */
+	retval = mapi_handles_slot_alloc(handles_ctx, &handle);
+	if (retval) {
+		mapi_handles_record_free(handles_ctx, el);
+		OPENCHANGE_RETVAL_ERR(retval, NULL);
 	}
 
-	el->handle = handles_ctx->last_handle;
+	/* Step 2. Fill and register the record */
+	el->handle = handle;
 	el->parent_handle = container_handle;
 	el->private_data = NULL;
-	*rec = el;
+	if (container_handle && container_handle < handles_ctx->slots_size
+	    && handles_ctx->slots[container_handle]) {
+		mapi_handles_link(handles_ctx->slots[container_handle], el);
+	}
+	handles_ctx->slots[handle] = el;
 	DLIST_ADD_END(handles_ctx->handles, el, struct mapi_handles *);
+	handles_ctx->count++;
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, 1);
+	*rec = el;
+
+	mapi_handles_tdb_store(handles_ctx, handle, container_handle);
 
 	OC_DEBUG(5, "handle 0x%.2x is a father of 0x%.2x", container_handle, el->handle);
-	handles_ctx->last_handle += 1;
-	talloc_free(mem_ctx);
 
 	return MAPI_E_SUCCESS;
 }
@@ -395,55 +499,62 @@ _PUBLIC_ enum MAPISTATUS mapi_handles_set_private_data(struct mapi_handles *hand
 }
 
 
-struct mapi_handles_private {
-	struct mapi_handles_context	*handles_ctx;
-	uint32_t			container_handle;
-};
+/**
+   \details Free a single handle record, without children
+
+   \param handles_ctx pointer to the MAPI handles context
+   \param el the record to free, already unlinked from its parent
+ */
+static void mapi_handles_delete_record(struct mapi_handles_context *handles_ctx,
+				       struct mapi_handles *el)
+{
+	uint32_t	handle = el->handle;
+
+	DLIST_REMOVE(handles_ctx->handles, el);
+	handles_ctx->count--;
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, -1);
+	mapi_handles_record_free(handles_ctx, el);
+	mapi_handles_slot_free(handles_ctx, handle);
+	mapi_handles_tdb_free(handles_ctx, handle);
+}
+
 
 /**
-   \details Traverse TDB database and search for records
-   which dbuf value is set to state.
- 
-   \param tdb_ctx pointer to the TDB context
-   \param key the current TDB key (potential child handle)
-   \param dbuf the current TDB value (parent handle)
-   \param state pointer on private data
-
-   \return 1 when a free record is found, otherwise 0
-*/
-static int mapi_handles_traverse_delete(TDB_CONTEXT *tdb_ctx,
-					TDB_DATA key, TDB_DATA dbuf,
-					void *state)
+   \details Free a handle record and all its descendants
+
+   Children go first, their private data may refer to the one of their
+   parent. The subtree is walked in post-order without recursion, so
+   the cost is linear in its size whatever its depth.
+
+   \param handles_ctx pointer to the MAPI handles context
+   \param el the record to free, already unlinked from its parent
+ */
+static void mapi_handles_delete_tree(struct mapi_handles_context *handles_ctx,
+				     struct mapi_handles *el)
 {
-	TALLOC_CTX			*mem_ctx;
-	struct mapi_handles_private	*handles_private = (struct mapi_handles_private *) state;
-	uint32_t			handle;
-	char				*container_handle_str = NULL;
-	char				*handle_str = NULL;
-
-	mem_ctx = talloc_named(NULL, 0, "mapi_handles_traverse_delete");
-	container_handle_str = talloc_asprintf(mem_ctx, "0x%x", handles_private->container_handle);
-
-	if (dbuf.dptr && strlen(container_handle_str) == dbuf.dsize && strncmp((const char *)dbuf.dptr, container_handle_str, dbuf.dsize) == 0) {
-		handle_str = talloc_strndup(mem_ctx, (char *)key.dptr, key.dsize);
-		OC_DEBUG(5, "handles being released must NOT have child handles attached to them (%s is a child of %s)", handle_str, container_handle_str);
-		handle = strtol((const char *) handle_str, NULL, 16);
-		/* abort(); */
-		/* DEBUG(5, ("deleting child handle: %d, %s\n", handle, handle_str)); */
-		mapi_handles_delete(handles_private->handles_ctx, handle);
-	}
+	struct mapi_handles	*node = el;
+	struct mapi_handles	*parent;
 
-	talloc_free(mem_ctx);
+	while (true) {
+		while (node->children) {
+			node = node->children;
+		}
+		if (node == el) break;
 
-	return 0;
-}
+		/* A leaf is always the head of its parent children */
+		parent = node->parent;
+		mapi_handles_unlink(node);
+		mapi_handles_delete_record(handles_ctx, node);
+		node = parent;
+	}
 
+	mapi_handles_delete_record(handles_ctx, el);
+}
 
 
 /**
    \details Remove the MAPI handle referenced by the handle parameter
-   from the double chained list and mark its associated TDB record as
-   null
+   from the handles table and release its children
 
    \param handles_ctx pointer to the MAPI handles context
    \param handle the handle to delete
@@ -453,56 +564,24 @@ static int mapi_handles_traverse_delete(TDB_CONTEXT *tdb_ctx,
 _PUBLIC_ enum MAPISTATUS mapi_handles_delete(struct mapi_handles_context *handles_ctx, 
 					     uint32_t handle)
 {
-	TALLOC_CTX			*mem_ctx;
-	enum MAPISTATUS			retval;
-	TDB_DATA			key;
 	struct mapi_handles		*el;
-	struct mapi_handles_private	handles_private;
-	int				ret;
-	bool				found = false;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!handles_ctx, MAPI_E_NOT_INITIALIZED, NULL);
-	OPENCHANGE_RETVAL_IF(!handles_ctx->tdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!handles_ctx->slots, MAPI_E_NOT_INITIALIZED, NULL);
 	OPENCHANGE_RETVAL_IF(handle == MAPI_HANDLES_RESERVED, MAPI_E_INVALID_PARAMETER, NULL);
 
-	OC_DEBUG(4, "Deleting MAPI handle 0x%x (handles_ctx: %p, tdb_ctx: %p)",
-		  handle, handles_ctx, handles_ctx->tdb_ctx);
-
-	mem_ctx = talloc_named(NULL, 0, "mapi_handles_delete");
-
-	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%x", handle);
-	key.dsize = strlen((const char *)key.dptr);
+	OC_DEBUG(4, "Deleting MAPI handle 0x%x (handles_ctx: %p)", handle, handles_ctx);
 
 	/* Step 1. Make sure the record exists */
-	ret = tdb_exists(handles_ctx->tdb_ctx, key);
-	OPENCHANGE_RETVAL_IF(!ret, MAPI_E_NOT_FOUND, mem_ctx);
-
-	/* Step 2. Delete this record from the double chained list */
-	for (el = handles_ctx->handles; el; el = el->next) {
-		if (el->handle == handle) {
-			DLIST_REMOVE(handles_ctx->handles, el);
-			talloc_free(el);
-			found = true;
-			break;
-		}
-	}
-	/* This case should never occur */
-	OPENCHANGE_RETVAL_IF(found == false, MAPI_E_CORRUPT_STORE, mem_ctx);
-
-	/* Step 3. Free this record within the TDB database */
-	retval = mapi_handles_tdb_free(handles_ctx, handle);
-	/* if (retval) { */
-	/* 	abort(); */
-	/* } */
-	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
-
-	/* Step 4. Delete hierarchy of children */
-	handles_private.handles_ctx = handles_ctx;
-	handles_private.container_handle = handle;
-	ret = tdb_traverse(handles_ctx->tdb_ctx, mapi_handles_traverse_delete, (void *)&handles_private);
-
-	talloc_free(mem_ctx);
+	OPENCHANGE_RETVAL_IF(handle >= handles_ctx->slots_size, MAPI_E_NOT_FOUND, NULL);
+	el = handles_ctx->slots[handle];
+	OPENCHANGE_RETVAL_IF(!el, MAPI_E_NOT_FOUND, NULL);
+
+	/* Step 2. Detach the record from its parent, then delete it
+	 * and its descendants from the list and the slot table */
+	mapi_handles_unlink(el);
+	mapi_handles_delete_tree(handles_ctx, el);
 
 	OC_DEBUG(4, "Deleting MAPI handle 0x%x COMPLETE", handle);
 
@@ -0,0 +1,242 @@
+/*
+   OpenChange Server implementation
+
+   Runtime statistics shared by the server processes
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapiproxy_stats.c
+
+   \brief Runtime statistics shared by the server processes
+
+   When mapiproxy:runtime_stats is enabled, every process serving
+   EMSMDB or NSPI maps a file named mapiproxy-<pid>.stats in
+   mapiproxy:runtime_stats_dir, laid out as struct mapiproxy_stats.
+   The servers update its counters and gauges with atomic increments,
+   without locking nor IPC, and readers such as the metrics controller
+   of ocsmanager open it at any time. The file also reserves an area
+   where libmapistore accounts the backend calls and the indexing
+   cache lookups of the process.
+
+   The file is mapped by the first session of a process. A process
+   forked afterwards maps a file of its own at its first session. The
+   file is removed when the process exits, and the files left behind
+   by processes which died without exiting are removed when another
+   one maps its own, so readers do not add up stale gauges.
+ */
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "libmapiproxy.h"
+
+/* Statistics of the current process, NULL when disabled */
+static struct mapiproxy_stats	*mapiproxy_stats = NULL;
+static pid_t			mapiproxy_stats_pid = 0;
+static char			*mapiproxy_stats_path = NULL;
+static bool			mapiproxy_stats_atexit = false;
+
+
+/**
+   \details Remove the statistics file of the current process when it
+   exits. Processes forked from it run the handler too, they only
+   remove a file they mapped themselves.
+ */
+static void mapiproxy_stats_exit(void)
+{
+	if (!mapiproxy_stats || !mapiproxy_stats_path) return;
+	if (mapiproxy_stats->pid != (uint32_t) getpid()) return;
+
+	unlink(mapiproxy_stats_path);
+}
+
+
+/**
+   \details Remove the statistics files of the processes which are
+   gone without removing theirs
+
+   \param dir the directory of the statistics files
+ */
+static void mapiproxy_stats_cleanup(const char *dir)
+{
+	DIR		*d;
+	struct dirent	*entry;
+	char		*path;
+	int		pid;
+	int		len;
+
+	d = opendir(dir);
+	if (!d) return;
+
+	while ((entry = readdir(d))) {
+		len = 0;
+		if (sscanf(entry->d_name, "mapiproxy-%d.stats%n", &pid, &len) != 1 ||
+		    !len || entry->d_name[len] || pid <= 0) {
+			continue;
+		}
+		if (kill((pid_t) pid, 0) == 0 || errno != ESRCH) continue;
+
+		path = talloc_asprintf(NULL, "%s/%s", dir, entry->d_name);
+		if (!path) break;
+		if (unlink(path) == 0) {
+			OC_DEBUG(3, "Removed runtime statistics file of dead process %d", pid);
+		}
+		talloc_free(path);
+	}
+	closedir(d);
+}
+
+
+/**
+   \details Map the statistics file of the current process, if enabled
+
+   \param lp_ctx pointer to the loadparm context
+
+   \return true if statistics are enabled, otherwise false
+ */
+_PUBLIC_ bool mapiproxy_stats_init(struct loadparm_context *lp_ctx)
+{
+	const char	*dir;
+	char		*path;
+	int		fd;
+	void		*addr;
+	pid_t		pid;
+
+	pid = getpid();
+	if (mapiproxy_stats_pid == pid) {
+		return (mapiproxy_stats != NULL);
+	}
+
+	/* Mapped by the process we were forked from, which still owns
+	 * the file */
+	if (mapiproxy_stats) {
+		munmap(mapiproxy_stats, sizeof (struct mapiproxy_stats));
+		mapiproxy_stats = NULL;
+	}
+	talloc_free(mapiproxy_stats_path);
+	mapiproxy_stats_path = NULL;
+	mapiproxy_stats_pid = pid;
+
+	if (!lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "runtime_stats", false)) {
+		return false;
+	}
+
+	dir = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "runtime_stats_dir");
+	if (!dir) {
+		dir = lpcfg_lock_directory(lp_ctx);
+	}
+
+	mapiproxy_stats_cleanup(dir);
+
+	path = talloc_asprintf(NULL, "%s/mapiproxy-%d.stats", dir, (int)pid);
+	if (!path) return false;
+
+	fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	if (fd == -1) {
+		OC_DEBUG(0, "Unable to open runtime statistics file %s: %s", path, strerror(errno));
+		talloc_free(path);
+		return false;
+	}
+
+	if (ftruncate(fd, sizeof (struct mapiproxy_stats)) == -1) {
+		OC_DEBUG(0, "Unable to size runtime statistics file %s: %s", path, strerror(errno));
+		close(fd);
+		talloc_free(path);
+		return false;
+	}
+
+	addr = mmap(NULL, sizeof (struct mapiproxy_stats), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		OC_DEBUG(0, "Unable to map runtime statistics file %s: %s", path, strerror(errno));
+		talloc_free(path);
+		return false;
+	}
+
+	mapiproxy_stats = (struct mapiproxy_stats *) addr;
+	mapiproxy_stats->pid = pid;
+	mapiproxy_stats->values_count = MAPIPROXY_STATS_VALUES;
+	mapiproxy_stats->started = time(NULL);
+	mapiproxy_stats->version = MAPIPROXY_STATS_VERSION;
+	/* Readers only trust the file once the magic is set */
+	__sync_synchronize();
+	mapiproxy_stats->magic = MAPIPROXY_STATS_MAGIC;
+
+	OC_DEBUG(3, "Runtime statistics written to %s", path);
+	mapiproxy_stats_path = path;
+	if (!mapiproxy_stats_atexit) {
+		mapiproxy_stats_atexit = (atexit(mapiproxy_stats_exit) == 0);
+	}
+
+	return true;
+}
+
+
+/**
+   \details Add to a counter or a gauge of the current process
+
+   Gauges stop at zero: a decrement for something counted before the
+   file was mapped must not wrap them around.
+
+   \param value the counter or gauge to update
+   \param delta the amount to add, negative to decrease a gauge
+ */
+_PUBLIC_ void mapiproxy_stats_add(enum mapiproxy_stats_value value, int64_t delta)
+{
+	uint64_t	*v;
+	uint64_t	old;
+	uint64_t	updated;
+
+	if (!mapiproxy_stats || value >= MAPIPROXY_STATS_MAX) return;
+
+	v = &mapiproxy_stats->values[value];
+	if (delta >= 0) {
+		__sync_fetch_and_add(v, (uint64_t) delta);
+		return;
+	}
+
+	do {
+		old = *v;
+		updated = (old > (uint64_t) -delta) ? old - (uint64_t) -delta : 0;
+	} while (!__sync_bool_compare_and_swap(v, old, updated));
+}
+
+
+/**
+   \details Return the area reserved for libmapistore in the
+   statistics file, see mapistore_set_shared_stats
+
+   \param sizep pointer to the size of the area to return
+
+   \return the area, NULL when statistics are disabled
+ */
+_PUBLIC_ void *mapiproxy_stats_mapistore_area(size_t *sizep)
+{
+	if (!mapiproxy_stats) return NULL;
+
+	if (sizep) {
+		*sizep = sizeof (mapiproxy_stats->mapistore);
+	}
+
+	return mapiproxy_stats->mapistore;
+}
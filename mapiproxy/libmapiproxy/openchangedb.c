@@ -44,17 +44,39 @@ const char *nil_string = "<nil>";
 _PUBLIC_ enum MAPISTATUS openchangedb_initialize(TALLOC_CTX *mem_ctx,
 						 struct loadparm_context *lp_ctx,
 						 struct openchangedb_context **oc_ctx)
+{
+	return openchangedb_initialize_url(mem_ctx, lp_ctx,
+					   lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "openchangedb"),
+					   oc_ctx);
+}
+
+/**
+   \details Initialize an openchangedb context on a given database
+   rather than the one of mapiproxy:openchangedb, with the same
+   logging and profiling options
+
+   \param mem_ctx pointer to the memory context
+   \param lp_ctx pointer to the loadparm context
+   \param openchangedb_backend the database URL
+   \param oc_ctx pointer on pointer to the openchangedb context to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_initialize_url(TALLOC_CTX *mem_ctx,
+						     struct loadparm_context *lp_ctx,
+						     const char *openchangedb_backend,
+						     struct openchangedb_context **oc_ctx)
 {
 	enum MAPISTATUS retval;
-	const char *openchangedb_backend = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy",
-							     "openchangedb");
+	bool logger, profile;
+	const char *trace;
 
 	if (openchangedb_backend == NULL) {
 		retval = MAPI_E_NOT_INITIALIZED;
 		oc_log(OC_LOG_ERROR, "No OpenChangeDB backend specified, please provision.");
 	} else if (strncmp(openchangedb_backend, "mysql:", strlen("mysql:")) == 0) {
 		oc_log(OC_LOG_ERROR, "Using MySQL backend for openchangedb: %s", openchangedb_backend);
-		retval = openchangedb_mysql_initialize(mem_ctx, lp_ctx, oc_ctx);
+		retval = openchangedb_mysql_initialize_url(mem_ctx, lp_ctx, openchangedb_backend, oc_ctx);
 	} else if (strncmp(openchangedb_backend, "ldb:", strlen("ldb:")) == 0) {
 		oc_log(OC_LOG_INFO, "Using ldb backend for openchangedb");
 		retval = openchangedb_ldb_initialize(mem_ctx,
@@ -69,11 +91,21 @@ _PUBLIC_ enum MAPISTATUS openchangedb_initialize(TALLOC_CTX *mem_ctx,
 		return retval;
 	}
 
-	if (lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "openchangedb_logger", false)) {
+	logger = lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "openchangedb_logger", false);
+	profile = lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "openchangedb_profile", false);
+	trace = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "openchangedb_trace");
+	if (logger || profile || trace) {
 		const char *prefix = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy",
 						       "openchangedb_logger_prefix");
 		OC_DEBUG(0, "Loading OpenchangeDB logger module\n");
-		retval = openchangedb_logger_initialize(mem_ctx, 0, prefix, *oc_ctx, oc_ctx);
+		/* Calls are only traced at a verbose level when profiling */
+		retval = openchangedb_logger_initialize(mem_ctx, logger ? 0 : 10, prefix, *oc_ctx, oc_ctx);
+		if (retval == MAPI_E_SUCCESS && (profile || trace)) {
+			retval = openchangedb_logger_set_profiling(*oc_ctx,
+								   lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "openchangedb_profile_interval", 300),
+								   lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "openchangedb_profile_top", 10),
+								   trace);
+		}
 	}
 
 	return retval;
@@ -477,6 +509,311 @@ _PUBLIC_ enum MAPISTATUS openchangedb_get_folder_count(struct openchangedb_conte
 	return oc_ctx->get_folder_count(oc_ctx, username, fid, RowCount);
 }
 
+/**
+   \details Retrieve the subfolders of a folder, all levels included,
+   with their properties
+
+   The folders are returned parent first, in the order of a hierarchy
+   table with the Depth flag. Backends unable to read the tree at once
+   return MAPI_E_NOT_IMPLEMENTED: callers walk the hierarchy instead.
+
+   \param mem_ctx pointer to the memory context
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the identifier of the subtree root, not returned
+   \param max_depth the number of levels to return, 0 for all
+   \param properties the properties to read for each folder
+   \param countp pointer to the returned number of folders
+   \param entriesp pointer to the returned folders
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_get_folder_tree(TALLOC_CTX *mem_ctx,
+						      struct openchangedb_context *oc_ctx,
+						      const char *username,
+						      uint64_t fid,
+						      uint32_t max_depth,
+						      struct SPropTagArray *properties,
+						      uint32_t *countp,
+						      struct openchangedb_folder_tree_entry **entriesp)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username || !properties, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!countp || !entriesp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->get_folder_tree(mem_ctx, oc_ctx, username, fid, max_depth, properties, countp, entriesp);
+}
+
+/**
+   \details Retrieve the stored number of folders within a folder's
+   hierarchy, all levels included
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the folder identifier
+   \param RowCount pointer to the returned number of folders
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if no count is
+   stored for the folder, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_get_recursive_folder_count(struct openchangedb_context *oc_ctx,
+								 const char *username,
+								 uint64_t fid,
+								 uint32_t *RowCount)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!RowCount, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->get_recursive_folder_count(oc_ctx, username, fid, RowCount);
+}
+
+/**
+   \details Store the number of folders within a folder's hierarchy,
+   all levels included
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the folder identifier
+   \param RowCount the number of folders
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_set_recursive_folder_count(struct openchangedb_context *oc_ctx,
+								 const char *username,
+								 uint64_t fid,
+								 uint32_t RowCount)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->set_recursive_folder_count(oc_ctx, username, fid, RowCount);
+}
+
+/**
+   \details Add delta to the stored recursive folder counts of a list of
+   folders, usually the ancestors of a created, moved or deleted
+   folder. Folders without a stored count are left alone.
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folders are
+   \param count the number of folder identifiers in fids
+   \param fids the folder identifiers
+   \param delta the number of folders added (or removed if negative)
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_update_recursive_folder_counts(struct openchangedb_context *oc_ctx,
+								     const char *username,
+								     uint32_t count,
+								     const uint64_t *fids,
+								     int32_t delta)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!count || !fids, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->update_recursive_folder_counts(oc_ctx, username, count, fids, delta);
+}
+
+/**
+   \details Forget the stored recursive folder counts of a list of
+   folders, they are computed again on the next lookup
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folders are
+   \param count the number of folder identifiers in fids, 0 for every
+   folder of the mailbox
+   \param fids the folder identifiers
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_clear_recursive_folder_counts(struct openchangedb_context *oc_ctx,
+								    const char *username,
+								    uint32_t count,
+								    const uint64_t *fids)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(count && !fids, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->clear_recursive_folder_counts(oc_ctx, username, count, fids);
+}
+
+/**
+   \details Retrieve the highest change number of the hierarchy changes
+   made within a folder's hierarchy, the folder itself included
+
+   The value stored for the mailbox root folder is the hierarchy change
+   number of the whole mailbox.
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the folder identifier
+   \param cn pointer to the returned change number
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if no change
+   number is stored for the folder, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_get_hierarchy_change_number(struct openchangedb_context *oc_ctx,
+								  const char *username,
+								  uint64_t fid,
+								  uint64_t *cn)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!cn, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->get_hierarchy_change_number(oc_ctx, username, fid, cn);
+}
+
+/**
+   \details Raise the hierarchy change number of a list of folders,
+   usually a changed folder and its ancestors. Stored change numbers
+   higher than cn are kept.
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folders are
+   \param count the number of folder identifiers in fids
+   \param fids the folder identifiers
+   \param cn the change number
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_set_hierarchy_change_numbers(struct openchangedb_context *oc_ctx,
+								   const char *username,
+								   uint32_t count,
+								   const uint64_t *fids,
+								   uint64_t cn)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!count || !fids, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->set_hierarchy_change_numbers(oc_ctx, username, count, fids, cn);
+}
+
+/**
+   \details Forget the hierarchy change numbers of a list of folders,
+   their hierarchy is walked again on the next synchronization
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folders are
+   \param count the number of folder identifiers in fids, 0 for every
+   folder of the mailbox
+   \param fids the folder identifiers
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_clear_hierarchy_change_numbers(struct openchangedb_context *oc_ctx,
+								     const char *username,
+								     uint32_t count,
+								     const uint64_t *fids)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(count && !fids, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->clear_hierarchy_change_numbers(oc_ctx, username, count, fids);
+}
+
+/**
+   \details Retrieve the message counters stored for a folder
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the folder identifier
+   \param max_age the age in seconds past which stored counters are
+   ignored, 0 for no limit
+   \param counts pointer to the returned counters
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if no counters
+   are stored for the folder or they are too old, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_get_message_counts(struct openchangedb_context *oc_ctx,
+							 const char *username,
+							 uint64_t fid,
+							 uint32_t max_age,
+							 struct openchangedb_message_counts *counts)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!counts, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->get_message_counts(oc_ctx, username, fid, max_age, counts);
+}
+
+/**
+   \details Store the message counters of a folder, counted from its
+   contents
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the folder identifier
+   \param counts the counters
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_set_message_counts(struct openchangedb_context *oc_ctx,
+							 const char *username,
+							 uint64_t fid,
+							 const struct openchangedb_message_counts *counts)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!counts, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->set_message_counts(oc_ctx, username, fid, counts);
+}
+
+/**
+   \details Add a change to the message counters stored for a
+   folder. Nothing is done when no counters are stored, and the
+   counters never go below 0.
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folder is
+   \param fid the folder identifier
+   \param delta the values to add to the counters
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_update_message_counts(struct openchangedb_context *oc_ctx,
+							    const char *username,
+							    uint64_t fid,
+							    const struct openchangedb_message_counts *delta)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!delta, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->update_message_counts(oc_ctx, username, fid, delta);
+}
+
+/**
+   \details Forget the message counters of a list of folders, their
+   contents are counted again on the next lookup
+
+   \param oc_ctx pointer to the openchange DB context
+   \param username name of the mailbox where the folders are
+   \param count the number of folder identifiers in fids, 0 for every
+   folder of the mailbox
+   \param fids the folder identifiers
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_clear_message_counts(struct openchangedb_context *oc_ctx,
+							   const char *username,
+							   uint32_t count,
+							   const uint64_t *fids)
+{
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(count && !fids, MAPI_E_INVALID_PARAMETER, NULL);
+
+	return oc_ctx->clear_message_counts(oc_ctx, username, count, fids);
+}
+
 /**
    FIXME Not used anywhere. Remove it?
    \details Check if a property exists within an openchange dispatcher
@@ -656,6 +993,50 @@ _PUBLIC_ enum MAPISTATUS openchangedb_get_folder_property(TALLOC_CTX *parent_ctx
 					   proptag, fid, data);
 }
 
+/**
+   \details Retrieve a set of MAPI property values from a folder record
+   in a single lookup
+
+   \param parent_ctx pointer to the memory context
+   \param oc_ctx pointer to the openchange DB context
+   \param username mailbox name where the folder is
+   \param properties the MAPI property tags to retrieve values for
+   \param fid the record folder identifier
+   \param data array of properties->cValues pointers to the data the
+   function returns
+   \param retvals array of properties->cValues status codes, one per
+   property
+
+   \return MAPI_E_SUCCESS if the folder record was looked up, otherwise
+   MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS openchangedb_get_folder_properties(TALLOC_CTX *parent_ctx,
+							    struct openchangedb_context *oc_ctx,
+							    const char *username,
+							    struct SPropTagArray *properties,
+							    uint64_t fid,
+							    void **data,
+							    enum MAPISTATUS *retvals)
+{
+	uint32_t	i;
+
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!properties || !data || !retvals, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (oc_ctx->get_folder_properties) {
+		return oc_ctx->get_folder_properties(parent_ctx, oc_ctx, username,
+						     properties, fid, data, retvals);
+	}
+
+	for (i = 0; i < properties->cValues; i++) {
+		retvals[i] = oc_ctx->get_folder_property(parent_ctx, oc_ctx, username,
+							 properties->aulPropTag[i], fid, data + i);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
 /**
    \details Set a MAPI property value from a folder record
 
@@ -0,0 +1,620 @@
+/*
+   OpenChange Server implementation
+
+   Restriction compiler and evaluator
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file restriction.c
+
+   \brief Compile mapi_SRestriction trees into flat predicate programs
+
+   A restriction is compiled once when the client sets it and then
+   evaluated for every candidate row. The program is stored in prefix
+   order: each instruction records the number of instructions of its
+   subtree, so AND/OR children are walked and skipped without
+   pointers.
+ */
+
+#include <ctype.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+#define	RESTRICTION_MAX_DEPTH	64
+
+struct restriction_compiler {
+	struct mapiproxy_restriction	*program;
+	uint32_t			size;
+	uint32_t			depth;
+};
+
+static enum MAPISTATUS restriction_emit(struct restriction_compiler *,
+					const struct mapi_SRestriction *,
+					enum mapiproxy_restriction_op);
+
+static struct mapiproxy_restriction_instr *restriction_append(struct restriction_compiler *compiler,
+							      enum mapiproxy_restriction_op op)
+{
+	struct mapiproxy_restriction	*program = compiler->program;
+	struct mapiproxy_restriction_instr	*instr;
+
+	if (program->count == compiler->size) {
+		compiler->size = compiler->size ? compiler->size * 2 : 8;
+		program->instrs = talloc_realloc(program, program->instrs,
+						 struct mapiproxy_restriction_instr, compiler->size);
+		if (!program->instrs) return NULL;
+	}
+
+	instr = &program->instrs[program->count++];
+	memset(instr, 0, sizeof (*instr));
+	instr->op = op;
+	instr->length = 1;
+
+	return instr;
+}
+
+static char *restriction_fold(TALLOC_CTX *mem_ctx, const char *str)
+{
+	char	*folded;
+	size_t	i;
+
+	folded = talloc_strdup(mem_ctx, str);
+	if (!folded) return NULL;
+
+	for (i = 0; folded[i]; i++) {
+		folded[i] = tolower((unsigned char)folded[i]);
+	}
+
+	return folded;
+}
+
+/**
+   \details Convert a restriction constant into its evaluation form
+
+   Strings are duplicated (and folded when ignore_case is set) so the
+   program does not reference the request buffer.
+ */
+static enum MAPISTATUS restriction_set_value(TALLOC_CTX *mem_ctx,
+					     struct mapiproxy_restriction_value *value,
+					     const struct mapi_SPropValue *prop,
+					     bool ignore_case)
+{
+	const char	*str;
+
+	value->type = prop->ulPropTag & 0xFFFF;
+	switch (value->type) {
+	case PT_I2:
+		value->u.i = prop->value.i;
+		break;
+	case PT_LONG:
+		value->u.i = prop->value.l;
+		break;
+	case PT_BOOLEAN:
+		value->u.i = prop->value.b ? 1 : 0;
+		break;
+	case PT_I8:
+		value->u.i = prop->value.d;
+		break;
+	case PT_SYSTIME:
+		value->u.i = ((uint64_t)prop->value.ft.dwHighDateTime << 32) | prop->value.ft.dwLowDateTime;
+		value->type = PT_I8;
+		break;
+	case PT_DOUBLE:
+		value->u.dbl = prop->value.dbl;
+		break;
+	case PT_STRING8:
+	case PT_UNICODE:
+		str = (value->type == PT_STRING8) ? prop->value.lpszA : prop->value.lpszW;
+		OPENCHANGE_RETVAL_IF(!str, MAPI_E_INVALID_PARAMETER, NULL);
+		value->type = PT_UNICODE;
+		value->u.str = ignore_case ? restriction_fold(mem_ctx, str) : talloc_strdup(mem_ctx, str);
+		OPENCHANGE_RETVAL_IF(!value->u.str, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		break;
+	case PT_BINARY:
+		value->u.bin.cb = prop->value.bin.cb;
+		value->u.bin.lpb = talloc_memdup(mem_ctx, prop->value.bin.lpb, prop->value.bin.cb ? prop->value.bin.cb : 1);
+		OPENCHANGE_RETVAL_IF(!value->u.bin.lpb, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		break;
+	default:
+		OC_DEBUG(5, "Unsupported restriction value type: 0x%.4x\n", value->type);
+		return MAPI_E_TOO_COMPLEX;
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Property tag the evaluator asks the row for
+
+   A PT_UNSPECIFIED tag takes the type of the constant it is compared
+   to, so the row provider always gets a fully typed tag.
+ */
+static enum MAPITAGS restriction_resolve_proptag(enum MAPITAGS proptag, const struct mapi_SPropValue *prop)
+{
+	if ((proptag & 0xFFFF) == PT_UNSPECIFIED && prop) {
+		return (enum MAPITAGS)((proptag & 0xFFFF0000) | (prop->ulPropTag & 0xFFFF));
+	}
+	return proptag;
+}
+
+static enum MAPISTATUS restriction_emit_children(struct restriction_compiler *compiler,
+						 enum mapiproxy_restriction_op op,
+						 enum mapiproxy_restriction_op parent_op,
+						 uint16_t count, const struct mapi_SRestriction *children)
+{
+	struct mapiproxy_restriction	*program = compiler->program;
+	enum MAPISTATUS			retval;
+	uint32_t			start;
+	uint16_t			i;
+
+	/* Single child: the connective is a no-op */
+	if (count == 1) {
+		return restriction_emit(compiler, &children[0], parent_op);
+	}
+
+	start = program->count;
+	OPENCHANGE_RETVAL_IF(!restriction_append(compiler, (count == 0) ?
+						  ((op == MAPIPROXY_RESTRICTION_AND) ? MAPIPROXY_RESTRICTION_TRUE : MAPIPROXY_RESTRICTION_FALSE) : op),
+			     MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	for (i = 0; i < count; i++) {
+		/* Nested connectives of the same kind are flattened */
+		retval = restriction_emit(compiler, &children[i], op);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+	program->instrs[start].length = program->count - start;
+
+	return MAPI_E_SUCCESS;
+}
+
+static enum MAPISTATUS restriction_emit(struct restriction_compiler *compiler,
+					const struct mapi_SRestriction *res,
+					enum mapiproxy_restriction_op parent_op)
+{
+	struct mapiproxy_restriction		*program = compiler->program;
+	struct mapiproxy_restriction_instr	*instr;
+	const struct mapi_SRestriction		*child;
+	enum MAPISTATUS				retval = MAPI_E_SUCCESS;
+	uint32_t				start;
+	uint16_t				i;
+
+	OPENCHANGE_RETVAL_IF(compiler->depth >= RESTRICTION_MAX_DEPTH, MAPI_E_TOO_COMPLEX, NULL);
+	compiler->depth++;
+
+	switch (res->rt) {
+	case RES_AND:
+	case RES_OR:
+		if ((res->rt == RES_AND && parent_op == MAPIPROXY_RESTRICTION_AND) ||
+		    (res->rt == RES_OR && parent_op == MAPIPROXY_RESTRICTION_OR)) {
+			for (i = 0; i < res->res.resAnd.cRes && retval == MAPI_E_SUCCESS; i++) {
+				child = (const struct mapi_SRestriction *)&res->res.resAnd.res[i];
+				retval = restriction_emit(compiler, child, parent_op);
+			}
+		} else if (res->rt == RES_AND) {
+			retval = restriction_emit_children(compiler, MAPIPROXY_RESTRICTION_AND, parent_op, res->res.resAnd.cRes,
+							   (const struct mapi_SRestriction *)res->res.resAnd.res);
+		} else {
+			retval = restriction_emit_children(compiler, MAPIPROXY_RESTRICTION_OR, parent_op, res->res.resOr.cRes,
+							   (const struct mapi_SRestriction *)res->res.resOr.res);
+		}
+		break;
+	case RES_NOT:
+		start = program->count;
+		OPENCHANGE_RETVAL_IF(!restriction_append(compiler, MAPIPROXY_RESTRICTION_NOT), MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		retval = restriction_emit(compiler, (const struct mapi_SRestriction *)&res->res.resNot.res,
+					  MAPIPROXY_RESTRICTION_NOT);
+		program->instrs[start].length = program->count - start;
+		break;
+	case RES_CONTENT:
+		instr = restriction_append(compiler, MAPIPROXY_RESTRICTION_CONTENT);
+		OPENCHANGE_RETVAL_IF(!instr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		instr->fuzzy = res->res.resContent.fuzzy;
+		instr->proptag = restriction_resolve_proptag(res->res.resContent.ulPropTag, &res->res.resContent.lpProp);
+		retval = restriction_set_value(program, &instr->value, &res->res.resContent.lpProp,
+					       (instr->fuzzy & FL_IGNORECASE) != 0);
+		if (retval == MAPI_E_SUCCESS && instr->value.type != PT_UNICODE && instr->value.type != PT_BINARY) {
+			retval = MAPI_E_TOO_COMPLEX;
+		}
+		break;
+	case RES_PROPERTY:
+		instr = restriction_append(compiler, MAPIPROXY_RESTRICTION_COMPARE);
+		OPENCHANGE_RETVAL_IF(!instr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		instr->relop = res->res.resProperty.relop;
+		instr->proptag = restriction_resolve_proptag(res->res.resProperty.ulPropTag, &res->res.resProperty.lpProp);
+		retval = restriction_set_value(program, &instr->value, &res->res.resProperty.lpProp, false);
+		break;
+	case RES_COMPAREPROPS:
+		instr = restriction_append(compiler, MAPIPROXY_RESTRICTION_COMPARE_PROPS);
+		OPENCHANGE_RETVAL_IF(!instr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		instr->relop = res->res.resCompareProps.relop;
+		instr->proptag = res->res.resCompareProps.ulPropTag1;
+		instr->proptag2 = res->res.resCompareProps.ulPropTag2;
+		break;
+	case RES_BITMASK:
+		instr = restriction_append(compiler, MAPIPROXY_RESTRICTION_BITMASK);
+		OPENCHANGE_RETVAL_IF(!instr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		instr->relop = res->res.resBitmask.relMBR;
+		instr->proptag = res->res.resBitmask.ulPropTag;
+		instr->mask = res->res.resBitmask.ulMask;
+		break;
+	case RES_SIZE:
+		instr = restriction_append(compiler, MAPIPROXY_RESTRICTION_SIZE);
+		OPENCHANGE_RETVAL_IF(!instr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		instr->relop = res->res.resSize.relop;
+		instr->proptag = res->res.resSize.ulPropTag;
+		instr->size = res->res.resSize.size;
+		break;
+	case RES_EXIST:
+		instr = restriction_append(compiler, MAPIPROXY_RESTRICTION_EXIST);
+		OPENCHANGE_RETVAL_IF(!instr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		instr->proptag = res->res.resExist.ulPropTag;
+		break;
+	case RES_COMMENT:
+		/* Comments only annotate the restriction they wrap */
+		if (res->res.resComment.RestrictionPresent && res->res.resComment.Restriction.res) {
+			retval = restriction_emit(compiler, (const struct mapi_SRestriction *)res->res.resComment.Restriction.res,
+						  parent_op);
+		} else {
+			OPENCHANGE_RETVAL_IF(!restriction_append(compiler, MAPIPROXY_RESTRICTION_TRUE), MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		}
+		break;
+	default:
+		OC_DEBUG(5, "Unsupported restriction type: 0x%x\n", res->rt);
+		retval = MAPI_E_TOO_COMPLEX;
+		break;
+	}
+
+	compiler->depth--;
+
+	return retval;
+}
+
+/**
+   \details Compile a restriction tree into a predicate program
+
+   \param mem_ctx pointer to the memory context
+   \param res pointer to the restriction to compile
+   \param programp pointer on pointer to the compiled program to return
+
+   \note Sub-object restrictions and value types the evaluator does not
+   know are rejected with MAPI_E_TOO_COMPLEX so callers can fall back
+   to their previous path.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_restriction_compile(TALLOC_CTX *mem_ctx,
+						       const struct mapi_SRestriction *res,
+						       struct mapiproxy_restriction **programp)
+{
+	struct restriction_compiler	compiler;
+	enum MAPISTATUS			retval;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!res, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!programp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	memset(&compiler, 0, sizeof (compiler));
+	compiler.program = talloc_zero(mem_ctx, struct mapiproxy_restriction);
+	OPENCHANGE_RETVAL_IF(!compiler.program, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = restriction_emit(&compiler, res, MAPIPROXY_RESTRICTION_TRUE);
+	OPENCHANGE_RETVAL_IF(retval, retval, compiler.program);
+
+	*programp = compiler.program;
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Load a row value into its evaluation form
+
+   \return false if the type cannot be evaluated
+ */
+static bool restriction_load_value(enum MAPITAGS proptag, const void *data,
+				   struct mapiproxy_restriction_value *value)
+{
+	const struct FILETIME	*ft;
+	const struct Binary_r	*bin;
+
+	value->type = proptag & 0xFFFF;
+	switch (value->type) {
+	case PT_I2:
+		value->u.i = *(const uint16_t *)data;
+		break;
+	case PT_LONG:
+		value->u.i = *(const uint32_t *)data;
+		break;
+	case PT_BOOLEAN:
+		value->u.i = *(const uint8_t *)data ? 1 : 0;
+		break;
+	case PT_I8:
+		value->u.i = *(const uint64_t *)data;
+		break;
+	case PT_SYSTIME:
+		ft = (const struct FILETIME *)data;
+		value->u.i = ((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+		value->type = PT_I8;
+		break;
+	case PT_DOUBLE:
+		value->u.dbl = *(const double *)data;
+		break;
+	case PT_STRING8:
+	case PT_UNICODE:
+		value->u.str = (const char *)data;
+		value->type = PT_UNICODE;
+		break;
+	case PT_BINARY:
+		bin = (const struct Binary_r *)data;
+		value->u.bin.cb = bin->cb;
+		value->u.bin.lpb = bin->lpb;
+		break;
+	default:
+		return false;
+	}
+
+	return true;
+}
+
+static bool restriction_is_integer(uint16_t type)
+{
+	return (type == PT_I2 || type == PT_LONG || type == PT_BOOLEAN || type == PT_I8);
+}
+
+/**
+   \details Three-way compare of two loaded values
+
+   \return false if the values are of incompatible types
+ */
+static bool restriction_compare_values(const struct mapiproxy_restriction_value *a,
+				       const struct mapiproxy_restriction_value *b,
+				       int *cmp)
+{
+	uint32_t	cb;
+
+	if (restriction_is_integer(a->type) && restriction_is_integer(b->type)) {
+		*cmp = (a->u.i < b->u.i) ? -1 : (a->u.i > b->u.i);
+		return true;
+	}
+	if (a->type != b->type) return false;
+
+	switch (a->type) {
+	case PT_DOUBLE:
+		*cmp = (a->u.dbl < b->u.dbl) ? -1 : (a->u.dbl > b->u.dbl);
+		return true;
+	case PT_UNICODE:
+		*cmp = strcasecmp(a->u.str, b->u.str);
+		return true;
+	case PT_BINARY:
+		cb = (a->u.bin.cb < b->u.bin.cb) ? a->u.bin.cb : b->u.bin.cb;
+		*cmp = cb ? memcmp(a->u.bin.lpb, b->u.bin.lpb, cb) : 0;
+		if (*cmp == 0) {
+			*cmp = (a->u.bin.cb < b->u.bin.cb) ? -1 : (a->u.bin.cb > b->u.bin.cb);
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool restriction_relop(uint8_t relop, int cmp)
+{
+	switch (relop) {
+	case RELOP_LT: return cmp < 0;
+	case RELOP_LE: return cmp <= 0;
+	case RELOP_GT: return cmp > 0;
+	case RELOP_GE: return cmp >= 0;
+	case RELOP_EQ: return cmp == 0;
+	case RELOP_NE: return cmp != 0;
+	default: return false;
+	}
+}
+
+static bool restriction_content_match(const struct mapiproxy_restriction_instr *instr,
+				      const struct mapiproxy_restriction_value *value)
+{
+	const uint8_t	*haystack, *needle;
+	uint32_t	hlen, nlen, i, j;
+	bool		ignore_case = (instr->fuzzy & FL_IGNORECASE) != 0;
+
+	if (value->type != instr->value.type) return false;
+
+	if (value->type == PT_UNICODE) {
+		haystack = (const uint8_t *)value->u.str;
+		hlen = strlen(value->u.str);
+		needle = (const uint8_t *)instr->value.u.str;
+		nlen = strlen(instr->value.u.str);
+	} else {
+		haystack = value->u.bin.lpb;
+		hlen = value->u.bin.cb;
+		needle = instr->value.u.bin.lpb;
+		nlen = instr->value.u.bin.cb;
+		ignore_case = false;
+	}
+
+	if (nlen > hlen) return false;
+
+	switch (instr->fuzzy & 0xFFFF) {
+	case FL_FULLSTRING:
+		if (nlen != hlen) return false;
+		hlen = nlen;
+		break;
+	case FL_PREFIX:
+		hlen = nlen;
+		break;
+	default:
+		break;
+	}
+
+	/* The needle has been folded at compile time */
+	for (i = 0; i + nlen <= hlen; i++) {
+		for (j = 0; j < nlen; j++) {
+			if ((ignore_case ? tolower(haystack[i + j]) : haystack[i + j]) != needle[j]) break;
+		}
+		if (j == nlen) return true;
+	}
+
+	return false;
+}
+
+static uint32_t restriction_value_size(const struct mapiproxy_restriction_value *value, uint16_t type)
+{
+	switch (type) {
+	case PT_I2:
+	case PT_BOOLEAN:
+		return 2;
+	case PT_LONG:
+		return 4;
+	case PT_STRING8:
+		return strlen(value->u.str) + 1;
+	case PT_UNICODE:
+		return (strlen(value->u.str) + 1) * 2;
+	case PT_BINARY:
+		return value->u.bin.cb;
+	default:
+		return 8;
+	}
+}
+
+static bool restriction_eval(const struct mapiproxy_restriction *program, uint32_t pc,
+			     mapiproxy_restriction_get_property_t get_property, void *private_data)
+{
+	const struct mapiproxy_restriction_instr	*instr = &program->instrs[pc];
+	struct mapiproxy_restriction_value		value, value2;
+	void						*data, *data2;
+	uint32_t					child, end, size;
+	int						cmp;
+
+	switch (instr->op) {
+	case MAPIPROXY_RESTRICTION_TRUE:
+		return true;
+	case MAPIPROXY_RESTRICTION_FALSE:
+		return false;
+	case MAPIPROXY_RESTRICTION_AND:
+	case MAPIPROXY_RESTRICTION_OR:
+		end = pc + instr->length;
+		for (child = pc + 1; child < end; child += program->instrs[child].length) {
+			if (restriction_eval(program, child, get_property, private_data) != (instr->op == MAPIPROXY_RESTRICTION_AND)) {
+				return (instr->op == MAPIPROXY_RESTRICTION_OR);
+			}
+		}
+		return (instr->op == MAPIPROXY_RESTRICTION_AND);
+	case MAPIPROXY_RESTRICTION_NOT:
+		return !restriction_eval(program, pc + 1, get_property, private_data);
+	default:
+		break;
+	}
+
+	/* Leaf predicates: a missing property never matches */
+	data = NULL;
+	if (get_property(private_data, instr->proptag, &data) != MAPI_E_SUCCESS || !data) {
+		return false;
+	}
+	if (instr->op == MAPIPROXY_RESTRICTION_EXIST) {
+		return true;
+	}
+	if (!restriction_load_value(instr->proptag, data, &value)) {
+		return false;
+	}
+
+	switch (instr->op) {
+	case MAPIPROXY_RESTRICTION_COMPARE:
+		if (!restriction_compare_values(&value, &instr->value, &cmp)) return false;
+		return restriction_relop(instr->relop, cmp);
+	case MAPIPROXY_RESTRICTION_CONTENT:
+		return restriction_content_match(instr, &value);
+	case MAPIPROXY_RESTRICTION_BITMASK:
+		if (!restriction_is_integer(value.type)) return false;
+		return (instr->relop == BMR_EQZ) ? ((value.u.i & instr->mask) == 0) : ((value.u.i & instr->mask) != 0);
+	case MAPIPROXY_RESTRICTION_SIZE:
+		size = restriction_value_size(&value, instr->proptag & 0xFFFF);
+		cmp = (size < instr->size) ? -1 : (size > instr->size);
+		return restriction_relop(instr->relop, cmp);
+	case MAPIPROXY_RESTRICTION_COMPARE_PROPS:
+		data2 = NULL;
+		if (get_property(private_data, instr->proptag2, &data2) != MAPI_E_SUCCESS || !data2) {
+			return false;
+		}
+		if (!restriction_load_value(instr->proptag2, data2, &value2)) return false;
+		if (!restriction_compare_values(&value, &value2, &cmp)) return false;
+		return restriction_relop(instr->relop, cmp);
+	default:
+		return false;
+	}
+}
+
+/**
+   \details Evaluate a compiled restriction against a row
+
+   \param program pointer to the compiled restriction, NULL matches
+   every row
+   \param get_property callback retrieving a property of the row
+   \param private_data opaque pointer passed to get_property
+
+   \return true if the row matches, otherwise false
+ */
+_PUBLIC_ bool mapiproxy_restriction_match(const struct mapiproxy_restriction *program,
+					  mapiproxy_restriction_get_property_t get_property,
+					  void *private_data)
+{
+	if (!program || !program->count) return true;
+	if (!get_property) return false;
+
+	return restriction_eval(program, 0, get_property, private_data);
+}
+
+/**
+   \details Add the properties read by a compiled restriction to a
+   property tag array, each tag once
+
+   \param mem_ctx pointer to the memory context of the array
+   \param program pointer to the compiled restriction, may be NULL
+   \param proptags pointer to the property tag array to extend
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_restriction_add_proptags(TALLOC_CTX *mem_ctx,
+							   const struct mapiproxy_restriction *program,
+							   struct SPropTagArray *proptags)
+{
+	enum MAPITAGS	tags[2];
+	uint32_t	i, k, t;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!proptags, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (!program) return MAPI_E_SUCCESS;
+
+	for (i = 0; i < program->count; i++) {
+		tags[0] = program->instrs[i].proptag;
+		tags[1] = program->instrs[i].proptag2;
+		for (t = 0; t < 2; t++) {
+			if (!tags[t]) continue;
+			for (k = 0; k < proptags->cValues && proptags->aulPropTag[k] != tags[t]; k++);
+			if (k < proptags->cValues) continue;
+
+			proptags->aulPropTag = talloc_realloc(mem_ctx, proptags->aulPropTag, enum MAPITAGS,
+							      proptags->cValues + 1);
+			OPENCHANGE_RETVAL_IF(!proptags->aulPropTag, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+			proptags->aulPropTag[proptags->cValues++] = tags[t];
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
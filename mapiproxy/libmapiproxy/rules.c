@@ -0,0 +1,653 @@
+/*
+   OpenChange Server implementation
+
+   Server-side rules
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file rules.c
+
+   \brief Storage and evaluation of the rules of a folder
+
+   The rules set with RopModifyRules are kept as the property rows the
+   client sent, packed in a single binary property of the folder
+   record in openchangedb. The condition of each rule is compiled with
+   the restriction compiler when the rules are loaded, so the delivery
+   path only has to walk the programs of the enabled rules, in
+   sequence order, against the properties of the new message.
+
+   Rules which condition can not be compiled never match: the server
+   leaves them to the client rather than acting on a guess.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+/**
+   \details Find a property in the row of a rule
+
+   \return pointer to the property, otherwise NULL
+ */
+static struct mapi_SPropValue *rules_find_property(const struct mapi_SPropValue_array *props, enum MAPITAGS proptag)
+{
+	uint32_t	i;
+
+	for (i = 0; i < props->cValues; i++) {
+		if (props->lpProps[i].ulPropTag == proptag) {
+			return &props->lpProps[i];
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Deep copy a property row through its NDR representation,
+   so the rule does not depend on the memory of the request it comes
+   from
+ */
+static enum MAPISTATUS rules_copy_props(TALLOC_CTX *mem_ctx, const struct mapi_SPropValue_array *src,
+					struct mapi_SPropValue_array *dst)
+{
+	TALLOC_CTX		*local_mem_ctx;
+	DATA_BLOB		blob;
+	enum ndr_err_code	ndr_err_code;
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	ndr_err_code = ndr_push_struct_blob(&blob, local_mem_ctx, src, (ndr_push_flags_fn_t)ndr_push_mapi_SPropValue_array);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_INVALID_PARAMETER, local_mem_ctx);
+
+	ndr_err_code = ndr_pull_struct_blob_all(&blob, mem_ctx, dst, (ndr_pull_flags_fn_t)ndr_pull_mapi_SPropValue_array);
+	talloc_free(local_mem_ctx);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_INVALID_PARAMETER, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Refresh the fields of a rule from its property row and
+   compile its condition
+ */
+static void rules_index(struct mapiproxy_rule *rule)
+{
+	struct mapi_SPropValue	*prop;
+	enum MAPISTATUS		retval;
+
+	prop = rules_find_property(&rule->props, PidTagRuleId);
+	rule->id = prop ? prop->value.d : 0;
+
+	prop = rules_find_property(&rule->props, PidTagRuleSequence);
+	rule->sequence = prop ? prop->value.l : 0;
+
+	prop = rules_find_property(&rule->props, PidTagRuleState);
+	rule->state = prop ? prop->value.l : 0;
+
+	prop = rules_find_property(&rule->props, PidTagRuleActions);
+	rule->actions = prop ? &prop->value.RuleAction : NULL;
+
+	talloc_free(rule->condition);
+	rule->condition = NULL;
+	prop = rules_find_property(&rule->props, PidTagRuleCondition);
+	if (prop) {
+		retval = mapiproxy_restriction_compile(rule->props.lpProps,
+						       (const struct mapi_SRestriction *) &prop->value.Restrictions,
+						       &rule->condition);
+		if (retval != MAPI_E_SUCCESS) {
+			OC_DEBUG(3, "condition of rule 0x%"PRIx64" is left to the client: %s",
+				 rule->id, mapi_get_errstr(retval));
+			rule->condition = NULL;
+		}
+	}
+}
+
+
+static int rules_cmp(const void *a, const void *b)
+{
+	const struct mapiproxy_rule	*ra = (const struct mapiproxy_rule *)a;
+	const struct mapiproxy_rule	*rb = (const struct mapiproxy_rule *)b;
+
+	if (ra->sequence != rb->sequence) {
+		return (ra->sequence < rb->sequence) ? -1 : 1;
+	}
+	if (ra->id != rb->id) {
+		return (ra->id < rb->id) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/**
+   \details Pack the rules of a folder into a blob
+
+   \param mem_ctx pointer to the memory context
+   \param rules pointer to the rules to pack
+   \param blob pointer to the blob to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_pack(TALLOC_CTX *mem_ctx, const struct mapiproxy_rules *rules, DATA_BLOB *blob)
+{
+	struct ndr_push		*ndr;
+	DATA_BLOB		row;
+	enum ndr_err_code	ndr_err_code;
+	uint32_t		i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!rules, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!blob, MAPI_E_INVALID_PARAMETER, NULL);
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	OPENCHANGE_RETVAL_IF(!ndr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+
+	ndr_push_uint32(ndr, NDR_SCALARS, MAPIPROXY_RULES_VERSION);
+	ndr_push_hyper(ndr, NDR_SCALARS, rules->next_id);
+	ndr_push_uint32(ndr, NDR_SCALARS, rules->count);
+	for (i = 0; i < rules->count; i++) {
+		ndr_err_code = ndr_push_struct_blob(&row, ndr, &rules->rules[i].props,
+						    (ndr_push_flags_fn_t)ndr_push_mapi_SPropValue_array);
+		OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_INVALID_PARAMETER, ndr);
+		ndr_push_DATA_BLOB(ndr, NDR_SCALARS, row);
+		talloc_free(row.data);
+	}
+
+	blob->data = talloc_steal(mem_ctx, ndr->data);
+	blob->length = ndr->offset;
+	talloc_free(ndr);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Unpack the rules of a folder from a blob
+
+   \param mem_ctx pointer to the memory context
+   \param blob pointer to the blob, an empty blob is a folder without
+   rules
+   \param rulesp pointer on pointer to the rules to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_unpack(TALLOC_CTX *mem_ctx, const DATA_BLOB *blob, struct mapiproxy_rules **rulesp)
+{
+	struct mapiproxy_rules	*rules;
+	struct ndr_pull		*ndr;
+	DATA_BLOB		row;
+	enum ndr_err_code	ndr_err_code;
+	uint32_t		version;
+	uint32_t		i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!blob, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!rulesp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	rules = talloc_zero(mem_ctx, struct mapiproxy_rules);
+	OPENCHANGE_RETVAL_IF(!rules, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	rules->next_id = 1;
+
+	if (!blob->length) {
+		*rulesp = rules;
+		return MAPI_E_SUCCESS;
+	}
+
+	ndr = ndr_pull_init_blob(blob, rules);
+	OPENCHANGE_RETVAL_IF(!ndr, MAPI_E_NOT_ENOUGH_MEMORY, rules);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+
+	ndr_err_code = ndr_pull_uint32(ndr, NDR_SCALARS, &version);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, rules);
+	OPENCHANGE_RETVAL_IF(version != MAPIPROXY_RULES_VERSION, MAPI_E_VERSION, rules);
+
+	ndr_err_code = ndr_pull_hyper(ndr, NDR_SCALARS, &rules->next_id);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, rules);
+	ndr_err_code = ndr_pull_uint32(ndr, NDR_SCALARS, &rules->count);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, rules);
+
+	rules->rules = talloc_zero_array(rules, struct mapiproxy_rule, rules->count);
+	OPENCHANGE_RETVAL_IF(rules->count && !rules->rules, MAPI_E_NOT_ENOUGH_MEMORY, rules);
+
+	for (i = 0; i < rules->count; i++) {
+		ndr_err_code = ndr_pull_DATA_BLOB(ndr, NDR_SCALARS, &row);
+		OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, rules);
+		ndr_err_code = ndr_pull_struct_blob_all(&row, rules->rules, &rules->rules[i].props,
+							(ndr_pull_flags_fn_t)ndr_pull_mapi_SPropValue_array);
+		OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, rules);
+		rules_index(&rules->rules[i]);
+	}
+	talloc_free(ndr);
+
+	*rulesp = rules;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Load the rules of a folder from openchangedb
+
+   \param mem_ctx pointer to the memory context
+   \param oc_ctx pointer to the openchangedb context
+   \param username the owner of the mailbox
+   \param fid the folder identifier
+   \param rulesp pointer on pointer to the rules to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT when the folder
+   has no openchangedb record, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_load(TALLOC_CTX *mem_ctx, struct openchangedb_context *oc_ctx,
+					      const char *username, uint64_t fid, struct mapiproxy_rules **rulesp)
+{
+	TALLOC_CTX		*local_mem_ctx;
+	enum MAPISTATUS		retval;
+	struct Binary_r		*bin = NULL;
+	DATA_BLOB		blob;
+	uint64_t		parent_fid;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!rulesp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = openchangedb_get_folder_property(local_mem_ctx, oc_ctx, username, MAPIPROXY_RULES_PROPTAG, fid, (void **)&bin);
+	if (retval == MAPI_E_SUCCESS && bin) {
+		blob.data = bin->lpb;
+		blob.length = bin->cb;
+	} else {
+		/* Rules can only be kept on folders openchangedb knows */
+		retval = openchangedb_get_parent_fid(oc_ctx, username, fid, &parent_fid, true);
+		OPENCHANGE_RETVAL_IF(retval, MAPI_E_NO_SUPPORT, local_mem_ctx);
+		blob = data_blob_null;
+	}
+
+	retval = mapiproxy_rules_unpack(mem_ctx, &blob, rulesp);
+	talloc_free(local_mem_ctx);
+
+	return retval;
+}
+
+
+/**
+   \details Store the rules of a folder in openchangedb
+
+   \param oc_ctx pointer to the openchangedb context
+   \param username the owner of the mailbox
+   \param fid the folder identifier
+   \param rules pointer to the rules to store
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_save(struct openchangedb_context *oc_ctx, const char *username,
+					      uint64_t fid, const struct mapiproxy_rules *rules)
+{
+	TALLOC_CTX		*mem_ctx;
+	enum MAPISTATUS		retval;
+	struct SRow		row;
+	struct SPropValue	prop;
+	DATA_BLOB		blob;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!oc_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!rules, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = mapiproxy_rules_pack(mem_ctx, rules, &blob);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	memset(&prop, 0, sizeof (prop));
+	prop.ulPropTag = MAPIPROXY_RULES_PROPTAG;
+	prop.value.bin.cb = blob.length;
+	prop.value.bin.lpb = blob.data;
+	row.cValues = 1;
+	row.lpProps = &prop;
+
+	retval = openchangedb_set_folder_properties(oc_ctx, username, fid, &row);
+	talloc_free(mem_ctx);
+
+	return retval;
+}
+
+
+/**
+   \details Return the index of a rule from the PidTagRuleId of a
+   request row
+
+   \return the index on success, otherwise -1
+ */
+static int rules_lookup(const struct mapiproxy_rules *rules, const struct mapi_SPropValue_array *props)
+{
+	struct mapi_SPropValue	*prop;
+	uint32_t		i;
+
+	prop = rules_find_property(props, PidTagRuleId);
+	if (!prop) return -1;
+
+	for (i = 0; i < rules->count; i++) {
+		if (rules->rules[i].id == prop->value.d) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+
+/**
+   \details Add a rule, the server assigns its PidTagRuleId
+ */
+static enum MAPISTATUS rules_add(struct mapiproxy_rules *rules, const struct mapi_SPropValue_array *props)
+{
+	struct mapiproxy_rule	*rule;
+	struct mapi_SPropValue	*prop;
+	struct mapi_SPropValue	*old_props;
+	enum MAPISTATUS		retval;
+	uint32_t		i;
+
+	OPENCHANGE_RETVAL_IF(!rules_find_property(props, PidTagRuleActions), MAPI_E_INVALID_PARAMETER, NULL);
+
+	rules->rules = talloc_realloc(rules, rules->rules, struct mapiproxy_rule, rules->count + 1);
+	OPENCHANGE_RETVAL_IF(!rules->rules, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	rule = &rules->rules[rules->count];
+	memset(rule, 0, sizeof (*rule));
+
+	/* Leave room for PidTagRuleId */
+	rule->props.cValues = 0;
+	rule->props.lpProps = talloc_array(rules->rules, struct mapi_SPropValue, props->cValues + 1);
+	OPENCHANGE_RETVAL_IF(!rule->props.lpProps, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	for (i = 0; i < props->cValues; i++) {
+		if (props->lpProps[i].ulPropTag == PidTagRuleId) continue;
+		rule->props.lpProps[rule->props.cValues++] = props->lpProps[i];
+	}
+	prop = &rule->props.lpProps[rule->props.cValues++];
+	prop->ulPropTag = PidTagRuleId;
+	prop->value.d = rules->next_id++;
+
+	/* Own the values instead of pointing into the request */
+	old_props = rule->props.lpProps;
+	retval = rules_copy_props(rules->rules, &rule->props, &rule->props);
+	talloc_free(old_props);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	rules->count++;
+	rules_index(rule);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Modify a rule: the properties of the request replace the
+   ones of the rule with the same tag and the others are appended
+ */
+static enum MAPISTATUS rules_modify(struct mapiproxy_rules *rules, uint32_t index,
+				    const struct mapi_SPropValue_array *props)
+{
+	struct mapiproxy_rule		*rule = &rules->rules[index];
+	struct mapi_SPropValue_array	merged;
+	struct mapi_SPropValue		*prop;
+	struct mapi_SPropValue		*old_props;
+	enum MAPISTATUS			retval;
+	uint32_t			i;
+
+	merged.cValues = rule->props.cValues;
+	merged.lpProps = talloc_array(rules->rules, struct mapi_SPropValue, rule->props.cValues + props->cValues);
+	OPENCHANGE_RETVAL_IF(!merged.lpProps, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	memcpy(merged.lpProps, rule->props.lpProps, rule->props.cValues * sizeof (struct mapi_SPropValue));
+
+	for (i = 0; i < props->cValues; i++) {
+		if (props->lpProps[i].ulPropTag == PidTagRuleId) continue;
+		prop = rules_find_property(&merged, props->lpProps[i].ulPropTag);
+		if (!prop) {
+			prop = &merged.lpProps[merged.cValues++];
+		}
+		*prop = props->lpProps[i];
+	}
+
+	old_props = rule->props.lpProps;
+	retval = rules_copy_props(rules->rules, &merged, &rule->props);
+	talloc_free(merged.lpProps);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	rule->condition = NULL;
+	talloc_free(old_props);
+	rules_index(rule);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static void rules_remove(struct mapiproxy_rules *rules, uint32_t index)
+{
+	talloc_free(rules->rules[index].props.lpProps);
+	memmove(&rules->rules[index], &rules->rules[index + 1],
+		(rules->count - index - 1) * sizeof (struct mapiproxy_rule));
+	rules->count--;
+}
+
+
+/**
+   \details Apply a RopModifyRules request to the rules of a folder
+
+   \param rules pointer to the rules of the folder
+   \param request pointer to the ModifyRules request
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND when a modified
+   or removed rule does not exist, otherwise MAPI error. The rules are
+   left in an undefined state on error and must not be saved.
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_modify(struct mapiproxy_rules *rules, const struct ModifyRules_req *request)
+{
+	const struct mapi_SPropValue_array	*props;
+	enum MAPISTATUS				retval;
+	uint32_t				i;
+	int					index;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!rules, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!request, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (request->ModifyRulesFlags & ModifyRulesFlag_Replace) {
+		while (rules->count) {
+			rules_remove(rules, rules->count - 1);
+		}
+	}
+
+	for (i = 0; i < request->RulesCount; i++) {
+		props = &request->RulesData[i].PropertyValues;
+		switch (request->RulesData[i].RuleDataFlags) {
+		case ROW_ADD:
+			retval = rules_add(rules, props);
+			OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+			break;
+		case ROW_MODIFY:
+			index = rules_lookup(rules, props);
+			OPENCHANGE_RETVAL_IF(index == -1, MAPI_E_NOT_FOUND, NULL);
+			retval = rules_modify(rules, index, props);
+			OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+			break;
+		case ROW_REMOVE:
+			index = rules_lookup(rules, props);
+			OPENCHANGE_RETVAL_IF(index == -1, MAPI_E_NOT_FOUND, NULL);
+			rules_remove(rules, index);
+			break;
+		default:
+			OC_DEBUG(3, "invalid rule data flags 0x%x", request->RulesData[i].RuleDataFlags);
+			return MAPI_E_INVALID_PARAMETER;
+		}
+	}
+
+	if (rules->count) {
+		qsort(rules->rules, rules->count, sizeof (struct mapiproxy_rule), rules_cmp);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve a property of a rule, in the form the table rows
+   are pushed from
+
+   PT_SRESTRICT and PT_ACTIONS values point to the mapi_SPropValue_CTR
+   union of the property.
+
+   \param mem_ctx pointer to the memory context
+   \param rule pointer to the rule
+   \param proptag the property to retrieve
+   \param data pointer on pointer to the value to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_FOUND
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rule_get_property(TALLOC_CTX *mem_ctx, const struct mapiproxy_rule *rule,
+						     enum MAPITAGS proptag, void **data)
+{
+	struct mapi_SPropValue	*prop;
+	struct Binary_r		*bin;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!rule, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!data, MAPI_E_INVALID_PARAMETER, NULL);
+
+	prop = rules_find_property(&rule->props, proptag);
+	OPENCHANGE_RETVAL_IF(!prop, MAPI_E_NOT_FOUND, NULL);
+
+	switch (proptag & 0xFFFF) {
+	case PT_BINARY:
+		bin = talloc_zero(mem_ctx, struct Binary_r);
+		OPENCHANGE_RETVAL_IF(!bin, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		bin->cb = prop->value.bin.cb;
+		bin->lpb = prop->value.bin.lpb;
+		*data = bin;
+		break;
+	case PT_SRESTRICT:
+	case PT_ACTIONS:
+		*data = &prop->value;
+		break;
+	default:
+		*data = (void *) get_mapi_SPropValue_data(prop);
+		OPENCHANGE_RETVAL_IF(!*data, MAPI_E_NOT_FOUND, NULL);
+		break;
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Return the properties the conditions of the rules read, so
+   they can be fetched at once before the rules are evaluated
+
+   \param mem_ctx pointer to the memory context
+   \param rules pointer to the rules
+   \param proptagsp pointer on pointer to the property tags to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_get_proptags(TALLOC_CTX *mem_ctx, const struct mapiproxy_rules *rules,
+						      struct SPropTagArray **proptagsp)
+{
+	struct SPropTagArray	*proptags;
+	enum MAPISTATUS		retval;
+	uint32_t		i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!rules, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!proptagsp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	proptags = talloc_zero(mem_ctx, struct SPropTagArray);
+	OPENCHANGE_RETVAL_IF(!proptags, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	proptags->aulPropTag = talloc_zero_array(proptags, enum MAPITAGS, 1);
+	OPENCHANGE_RETVAL_IF(!proptags->aulPropTag, MAPI_E_NOT_ENOUGH_MEMORY, proptags);
+
+	for (i = 0; i < rules->count; i++) {
+		retval = mapiproxy_restriction_add_proptags(proptags, rules->rules[i].condition, proptags);
+		OPENCHANGE_RETVAL_IF(retval, retval, proptags);
+	}
+
+	*proptagsp = proptags;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Evaluate the rules of a folder against a message
+
+   Disabled rules, rules in error, rules only active while out of
+   office and rules which condition could not be compiled are
+   skipped. Evaluation stops after the first matching rule flagged as
+   exit level.
+
+   \param mem_ctx pointer to the memory context
+   \param rules pointer to the rules of the folder
+   \param get_property callback retrieving a property of the message
+   \param private_data opaque pointer passed to get_property
+   \param matchedp pointer on pointer to the matching rules to return,
+   in sequence order
+   \param countp pointer to the number of matching rules to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_rules_evaluate(TALLOC_CTX *mem_ctx, const struct mapiproxy_rules *rules,
+						  mapiproxy_restriction_get_property_t get_property, void *private_data,
+						  const struct mapiproxy_rule ***matchedp, uint32_t *countp)
+{
+	const struct mapiproxy_rule	**matched;
+	const struct mapiproxy_rule	*rule;
+	uint32_t			i, count = 0;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!rules, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!get_property, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!matchedp, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!countp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	matched = talloc_zero_array(mem_ctx, const struct mapiproxy_rule *, rules->count + 1);
+	OPENCHANGE_RETVAL_IF(!matched, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	for (i = 0; i < rules->count; i++) {
+		rule = &rules->rules[i];
+		if (!(rule->state & MAPIPROXY_RULE_ENABLED)) continue;
+		if (rule->state & (MAPIPROXY_RULE_ERROR|MAPIPROXY_RULE_PARSE_ERROR|MAPIPROXY_RULE_ONLY_WHEN_OOF)) continue;
+		if (!rule->condition || !rule->actions) continue;
+
+		if (!mapiproxy_restriction_match(rule->condition, get_property, private_data)) continue;
+
+		matched[count++] = rule;
+		if (rule->state & MAPIPROXY_RULE_EXIT_LEVEL) break;
+	}
+
+	*matchedp = matched;
+	*countp = count;
+
+	return MAPI_E_SUCCESS;
+}
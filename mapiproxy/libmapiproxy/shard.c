@@ -0,0 +1,257 @@
+/*
+   OpenChange Server implementation
+
+   Mailbox to node affinity
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file shard.c
+
+   \brief Consistent hashing of mailbox owners over the OpenChange
+   nodes
+
+   When mapiproxy:shard_nodes lists the nodes of a cluster, each
+   mailbox is served by a single node, so the caches of the node stay
+   hot. Every node is given mapiproxy:shard_vnodes points on a
+   32 bits ring, and a mailbox belongs to the node of the first point
+   following the hash of its owner. Adding or removing a node only
+   moves the mailboxes of its neighbours.
+
+   The same ring is computed by the python services (autodiscover and
+   rpcproxy) in openchange/shard.py: both implementations must be kept
+   in sync.
+ */
+
+#include <ctype.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+#define	SHARD_DEFAULT_VNODES	64
+
+/* The ring of the process, loaded from the configuration on first use */
+static struct mapiproxy_shard_ring	*shard_ring = NULL;
+static bool				shard_ring_loaded = false;
+
+
+/**
+   \details Hash a string in a case insensitive way
+
+   FNV-1a over the lower case bytes of the string, followed by the
+   murmur3 finalizer so that close strings land far apart on the ring.
+
+   \param str the string to hash
+
+   \return the 32 bits hash
+ */
+_PUBLIC_ uint32_t mapiproxy_shard_hash(const char *str)
+{
+	uint32_t	hash = 2166136261U;
+
+	if (!str) return 0;
+
+	for (; *str; str++) {
+		hash = (hash ^ (uint8_t) tolower((unsigned char) *str)) * 16777619U;
+	}
+
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6bU;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35U;
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+
+static int shard_point_cmp(const void *a, const void *b)
+{
+	const struct mapiproxy_shard_point	*pa = (const struct mapiproxy_shard_point *)a;
+	const struct mapiproxy_shard_point	*pb = (const struct mapiproxy_shard_point *)b;
+
+	if (pa->hash != pb->hash) {
+		return (pa->hash < pb->hash) ? -1 : 1;
+	}
+	if (pa->node != pb->node) {
+		return (pa->node < pb->node) ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+/**
+   \details Build a ring from a list of nodes
+
+   \param mem_ctx pointer to the memory context
+   \param nodes NULL terminated list of node names
+   \param vnodes number of points given to each node
+   \param ringp pointer on pointer to the ring to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS mapiproxy_shard_ring_init(TALLOC_CTX *mem_ctx, const char * const *nodes,
+						   uint32_t vnodes, struct mapiproxy_shard_ring **ringp)
+{
+	struct mapiproxy_shard_ring	*ring;
+	char				*name;
+	uint32_t			i, j;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!nodes || !nodes[0], MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!vnodes, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!ringp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	ring = talloc_zero(mem_ctx, struct mapiproxy_shard_ring);
+	OPENCHANGE_RETVAL_IF(!ring, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	for (ring->node_count = 0; nodes[ring->node_count]; ring->node_count++);
+	ring->nodes = talloc_array(ring, char *, ring->node_count);
+	ring->count = ring->node_count * vnodes;
+	ring->points = talloc_array(ring, struct mapiproxy_shard_point, ring->count);
+	OPENCHANGE_RETVAL_IF(!ring->nodes || !ring->points, MAPI_E_NOT_ENOUGH_MEMORY, ring);
+
+	for (i = 0; i < ring->node_count; i++) {
+		ring->nodes[i] = strlower_talloc(ring->nodes, nodes[i]);
+		OPENCHANGE_RETVAL_IF(!ring->nodes[i], MAPI_E_NOT_ENOUGH_MEMORY, ring);
+
+		for (j = 0; j < vnodes; j++) {
+			name = talloc_asprintf(ring, "%s#%u", ring->nodes[i], j);
+			OPENCHANGE_RETVAL_IF(!name, MAPI_E_NOT_ENOUGH_MEMORY, ring);
+			ring->points[i * vnodes + j].hash = mapiproxy_shard_hash(name);
+			ring->points[i * vnodes + j].node = i;
+			talloc_free(name);
+		}
+	}
+	qsort(ring->points, ring->count, sizeof (struct mapiproxy_shard_point), shard_point_cmp);
+
+	*ringp = ring;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Return the node a mailbox belongs to
+
+   \param ring pointer to the ring
+   \param owner the account name of the mailbox owner
+
+   \return the name of the node on success, otherwise NULL
+ */
+_PUBLIC_ const char *mapiproxy_shard_ring_lookup(const struct mapiproxy_shard_ring *ring, const char *owner)
+{
+	uint32_t	hash;
+	uint32_t	lo, hi, mid;
+
+	if (!ring || !ring->count || !owner) return NULL;
+
+	/* First point at or after the hash, wrapping around */
+	hash = mapiproxy_shard_hash(owner);
+	lo = 0;
+	hi = ring->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (ring->points[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (lo == ring->count) {
+		lo = 0;
+	}
+
+	return ring->nodes[ring->points[lo].node];
+}
+
+
+/**
+   \details Return the ring of the process, as configured in smb.conf
+
+   \param lp_ctx pointer to the loadparm context
+
+   \return the ring when mapiproxy:shard_nodes is set, otherwise
+   NULL
+ */
+_PUBLIC_ const struct mapiproxy_shard_ring *mapiproxy_shard_ring_get(struct loadparm_context *lp_ctx)
+{
+	TALLOC_CTX		*mem_ctx;
+	const char		**nodes;
+	const char		*local;
+	enum MAPISTATUS		retval;
+	int			vnodes;
+
+	if (shard_ring_loaded || !lp_ctx) return shard_ring;
+	shard_ring_loaded = true;
+
+	nodes = lpcfg_parm_string_list(NULL, lp_ctx, NULL, "mapiproxy", "shard_nodes", NULL);
+	if (!nodes || !nodes[0]) {
+		talloc_free(nodes);
+		return NULL;
+	}
+
+	vnodes = lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "shard_vnodes", SHARD_DEFAULT_VNODES);
+	retval = mapiproxy_shard_ring_init(NULL, nodes, (vnodes > 0) ? vnodes : SHARD_DEFAULT_VNODES, &shard_ring);
+	talloc_free(nodes);
+	if (retval != MAPI_E_SUCCESS) {
+		OC_DEBUG(0, "Unable to build the shard ring: %s", mapi_get_errstr(retval));
+		shard_ring = NULL;
+		return NULL;
+	}
+
+	mem_ctx = talloc_new(NULL);
+	local = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "shard_node");
+	if (!local) {
+		local = talloc_asprintf(mem_ctx, "%s.%s", lpcfg_netbios_name(lp_ctx), lpcfg_realm(lp_ctx));
+	}
+	shard_ring->local = strlower_talloc(shard_ring, local);
+	talloc_free(mem_ctx);
+
+	OC_DEBUG(3, "Mailboxes sharded over %u nodes, this one is %s", shard_ring->node_count, shard_ring->local);
+
+	return shard_ring;
+}
+
+
+/**
+   \details Tell whether a mailbox is served by another node
+
+   \param lp_ctx pointer to the loadparm context
+   \param owner the account name of the mailbox owner
+
+   \return the name of the node serving the mailbox when it is not this
+   one, otherwise NULL
+ */
+_PUBLIC_ const char *mapiproxy_shard_redirect(struct loadparm_context *lp_ctx, const char *owner)
+{
+	const struct mapiproxy_shard_ring	*ring;
+	const char				*node;
+
+	ring = mapiproxy_shard_ring_get(lp_ctx);
+	if (!ring) return NULL;
+
+	node = mapiproxy_shard_ring_lookup(ring, owner);
+	if (!node || !ring->local || !strcmp(node, ring->local)) {
+		return NULL;
+	}
+
+	return node;
+}
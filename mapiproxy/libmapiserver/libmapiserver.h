@@ -126,6 +126,22 @@
  */
 #define	SIZE_DFLT_ROPSAVECHANGESMESSAGE		9
 
+/**
+   \details ReadRecipients has fixed response size for:
+   -# RowCount: uint8_t
+ */
+#define	SIZE_DFLT_ROPREADRECIPIENTS		1
+
+/**
+   \details ReadRecipientRow has fixed size for:
+   -# RowId: uint32_t
+   -# RecipientType: uint8_t
+   -# CodePageId: uint16_t
+   -# Reserved: uint16_t
+   -# RecipientRow size: uint16_t
+ */
+#define	SIZE_DFLT_READRECIPIENTROW		11
+
 /**
    \details ReloadCachedInformation has fixed response size for:
    -# HasNamedProperties: uint8_t
@@ -140,6 +156,12 @@
  */
 #define	SIZE_DFLT_ROPSETMESSAGEREADFLAG		1
 
+/**
+   \details: SetReadFlags has fixed response size for:
+   -# PartialCompletion: uint8_t
+ */
+#define	SIZE_DFLT_ROPSETREADFLAGS		1
+
 /**
    \details: GetMessageStatus has fixed response size for:
    -# MessageStatusFlags: uint32_t
@@ -202,6 +224,20 @@
  */
 #define	SIZE_DFLT_ROPSEEKROW			5
 
+/**
+   \details SeekRowBookmarkRop has fixed response size for:
+   -# RowNoLongerVisible: uint8_t
+   -# HasSoughtLess: uint8_t
+   -# RowsSought: uint32_t
+ */
+#define	SIZE_DFLT_ROPSEEKROWBOOKMARK		6
+
+/**
+   \details CreateBookmarkRop has fixed response size for:
+   -# BookmarkSize: uint16_t
+ */
+#define	SIZE_DFLT_ROPCREATEBOOKMARK		2
+
 /**
    \details CreateFolderRop has fixed response size for:
    -# folder_id: uint64_t
@@ -286,6 +322,31 @@
  */
 #define	SIZE_DFLT_ROPFINDROW			2
 
+/**
+   \details ExpandRow has fixed response size for:
+   -# ExpandedRowCount: uint32_t
+   -# RowCount: uint16_t
+ */
+#define	SIZE_DFLT_ROPEXPANDROW			6
+
+/**
+   \details CollapseRow has fixed response size for:
+   -# CollapsedRowCount: uint32_t
+ */
+#define	SIZE_DFLT_ROPCOLLAPSEROW		4
+
+/**
+   \details GetCollapseState has fixed response size for:
+   -# CollapseStateSize: uint16_t
+ */
+#define	SIZE_DFLT_ROPGETCOLLAPSESTATE		2
+
+/**
+   \details SetCollapseState has fixed response size for:
+   -# BookmarkSize: uint16_t
+ */
+#define	SIZE_DFLT_ROPSETCOLLAPSESTATE		2
+
 /**
    \details GetNamesFromIDs has fixed response size for:
    -# PropertyNameCount: uint16_t
@@ -477,6 +538,23 @@
  */
 #define SIZE_DFLT_ROPGETLOCALREPLICAIDS 22
 
+/**
+   \details Backoff has a fixed response size for:
+   -# RopId: uint8_t
+   -# LogonId: uint8_t
+   -# Duration: uint32_t
+   -# BackoffRopCount: uint8_t
+   -# AdditionalDataSize: uint16_t
+ */
+#define SIZE_DFLT_ROPBACKOFF 9
+
+/**
+   \details BackoffRop structure is fixed size:
+   -# RopIdBackoff: uint8_t
+   -# Duration: uint32_t
+ */
+#define SIZE_DFLT_BACKOFFROP 5
+
 __BEGIN_DECLS
 
 /* definitions from libmapiserver_oxcfold.c */
@@ -500,8 +578,10 @@ uint16_t libmapiserver_RopCreateMessage_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopSaveChangesMessage_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopRemoveAllRecipients_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopModifyRecipients_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopReadRecipients_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopReloadCachedInformation_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopSetMessageReadFlag_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopSetReadFlags_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopGetMessageStatus_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopGetAttachmentTable_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopOpenAttach_size(struct EcDoRpc_MAPI_REPL *);
@@ -512,6 +592,7 @@ uint16_t libmapiserver_RopOpenEmbeddedMessage_size(struct EcDoRpc_MAPI_REPL *res
 /* definitions from libmapiserver_oxcnotif.c */
 uint16_t libmapiserver_RopRegisterNotification_size(void);
 uint16_t libmapiserver_RopNotify_size(struct EcDoRpc_MAPI_REPL *);
+uint32_t libmapiserver_RopNotify_coalesce(struct EcDoRpc_MAPI_REPL *, uint32_t, uint32_t);
 
 /* definitions from libmapiserver_oxcdata.c */
 uint16_t libmapiserver_TypedString_size(struct TypedString);
@@ -537,7 +618,9 @@ uint16_t libmapiserver_RopGetNamesFromIDs_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopGetPropertyIdsFromNames_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopDeletePropertiesNoReplicate_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopCopyTo_size(struct EcDoRpc_MAPI_REPL *);
+void libmapiserver_push_unicode(struct ndr_push *, const char *);
 int libmapiserver_push_property(TALLOC_CTX *, uint32_t, const void *, DATA_BLOB *, uint8_t, uint8_t, uint8_t);
+int libmapiserver_push_property_row(TALLOC_CTX *, DATA_BLOB *, uint16_t, const enum MAPITAGS *, void **, const enum MAPISTATUS *, const bool *, uint8_t, bool);
 struct SRow *libmapiserver_ROP_request_to_properties(TALLOC_CTX *, void *, uint8_t);
 
 /* definitions from libmapiserver_oxcstor.c */
@@ -552,6 +635,7 @@ uint16_t libmapiserver_RopReadPerUserInformation_size(struct EcDoRpc_MAPI_REPL *
 uint16_t libmapiserver_RopGetPerUserGuid_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopGetStoreState_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopGetReceiveFolderTable_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopBackoff_size(struct EcDoRpc_MAPI_REPL *);
 
 /* definitions from libmapiserver_oxctabl.c */
 uint16_t libmapiserver_RopSetColumns_size(struct EcDoRpc_MAPI_REPL *);
@@ -560,8 +644,15 @@ uint16_t libmapiserver_RopRestrict_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopQueryRows_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopQueryPosition_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopSeekRow_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopSeekRowBookmark_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopCreateBookmark_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopFindRow_size(struct EcDoRpc_MAPI_REPL *);
 uint16_t libmapiserver_RopResetTable_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopFreeBookmark_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopExpandRow_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopCollapseRow_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopGetCollapseState_size(struct EcDoRpc_MAPI_REPL *);
+uint16_t libmapiserver_RopSetCollapseState_size(struct EcDoRpc_MAPI_REPL *);
 
 /* definitions from libmapiserver_oxomsg.c */
 uint16_t libmapiserver_RopSubmitMessage_size(struct EcDoRpc_MAPI_REPL *);
@@ -215,7 +215,7 @@ _PUBLIC_ uint16_t libmapiserver_mapi_SPropValue_size(uint16_t cValues, struct ma
 			size += strlen(lpProps[i].value.lpszA) + 1;
 			break;
 		case PT_UNICODE:
-			size += strlen(lpProps[i].value.lpszW) * 2 + 2;
+			size += mapi_utf16_size(lpProps[i].value.lpszW);
 			break;
 		case PT_SYSTIME:
 			size += sizeof (uint32_t) * 2;
@@ -244,7 +244,7 @@ _PUBLIC_ uint16_t libmapiserver_mapi_SPropValue_size(uint16_t cValues, struct ma
 		case PT_MV_UNICODE:
 			size += sizeof (uint32_t);
 			for (j = 0; j < lpProps[i].value.MVszW.cValues; j++) {
-				size += strlen(lpProps[i].value.MVszW.strings[j].lppszW) * 2 + 2;
+				size += mapi_utf16_size(lpProps[i].value.MVszW.strings[j].lppszW);
 			}
 			break;
 		case PT_MV_CLSID:
@@ -142,6 +142,33 @@ _PUBLIC_ uint16_t libmapiserver_RopModifyRecipients_size(struct EcDoRpc_MAPI_REP
 }
 
 
+/**
+   \details Calculate ReadRecipients (0xf) Rop size
+
+   \param response pointer to the ReadRecipients EcDoRpc_MAPI_REPL
+   structure
+
+   \return Size of ReadRecipients response
+ */
+_PUBLIC_ uint16_t libmapiserver_RopReadRecipients_size(struct EcDoRpc_MAPI_REPL *response)
+{
+	uint16_t	size = SIZE_DFLT_MAPI_RESPONSE;
+	uint8_t		i;
+
+	if (!response || response->error_code) {
+		return size;
+	}
+
+	size += SIZE_DFLT_ROPREADRECIPIENTS;
+	for (i = 0; i < response->u.mapi_ReadRecipients.RowCount; i++) {
+		size += SIZE_DFLT_READRECIPIENTROW;
+		size += libmapiserver_RecipientRow_size(response->u.mapi_ReadRecipients.RecipientRows[i].RecipientRow);
+	}
+
+	return size;
+}
+
+
 /**
    \details Calculate ReloadCachedInformation (0x10) Rop size
 
@@ -209,6 +236,28 @@ _PUBLIC_ uint16_t libmapiserver_RopSetMessageReadFlag_size(struct EcDoRpc_MAPI_R
 }
 
 
+/**
+   \details Calculate SetReadFlags (0x66) Rop size
+
+   \param response pointer to the SetReadFlags EcDoRpc_MAPI_REPL
+   structure
+
+   \return Size of SetReadFlags response
+ */
+_PUBLIC_ uint16_t libmapiserver_RopSetReadFlags_size(struct EcDoRpc_MAPI_REPL *response)
+{
+	uint16_t	size = SIZE_DFLT_MAPI_RESPONSE;
+
+	if (!response || response->error_code) {
+		return size;
+	}
+
+	size += SIZE_DFLT_ROPSETREADFLAGS;
+
+	return size;
+}
+
+
 /**
    \details Calculate GetMessageStatus (0x1f) Rop size
 
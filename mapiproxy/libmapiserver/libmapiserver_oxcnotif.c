@@ -22,7 +22,8 @@
 /**
    \file libmapiserver_oxcnotif.c
 
-   \brief OXCNOTIF ROP Response size calculations
+   \brief OXCNOTIF ROP Response size calculations and Notify
+   coalescing
  */
 
 
@@ -220,3 +221,153 @@ _PUBLIC_ uint16_t libmapiserver_RopNotify_size(struct EcDoRpc_MAPI_REPL *respons
 
         return size;
 }
+
+
+/**
+   \details Return the table event of a TableModified notification
+
+   \param response pointer to the Notify reply
+
+   \return pointer to the TableEvent field, NULL if response is not a
+   TableModified notification
+ */
+static enum RichTableNotificationType *libmapiserver_RopNotify_table_event(struct EcDoRpc_MAPI_REPL *response)
+{
+	union NotificationData	*NotificationData;
+
+	if (response->opnum != op_MAPI_Notify) return NULL;
+
+	NotificationData = &response->u.mapi_Notify.NotificationData;
+	switch (response->u.mapi_Notify.NotificationType) {
+	case 0x0100: /* hierarchy table changed */
+		return &NotificationData->HierarchyTableChange.TableEvent;
+	case 0x8100: /* contents table changed */
+		return &NotificationData->ContentsTableChange.TableEvent;
+	case 0xc100: /* search table changed */
+		return &NotificationData->SearchTableChange.TableEvent;
+	default:
+		return NULL;
+	}
+}
+
+/**
+   \details Check if two TableModified notifications are raised on
+   the same table of the same subscription
+ */
+static bool libmapiserver_RopNotify_same_table(struct EcDoRpc_MAPI_REPL *a, struct EcDoRpc_MAPI_REPL *b)
+{
+	return (a->u.mapi_Notify.NotificationHandle == b->u.mapi_Notify.NotificationHandle &&
+		a->u.mapi_Notify.NotificationType == b->u.mapi_Notify.NotificationType);
+}
+
+/**
+   \details Check if two TABLE_ROW_MODIFIED notifications describe the
+   same row of the same table
+ */
+static bool libmapiserver_RopNotify_same_row(struct EcDoRpc_MAPI_REPL *a, struct EcDoRpc_MAPI_REPL *b)
+{
+	struct ContentsRowModifiedNotification	*ca;
+	struct ContentsRowModifiedNotification	*cb;
+
+	if (!libmapiserver_RopNotify_same_table(a, b)) return false;
+	if (*libmapiserver_RopNotify_table_event(b) != TABLE_ROW_MODIFIED) return false;
+
+	switch (a->u.mapi_Notify.NotificationType) {
+	case 0x0100:
+		return (a->u.mapi_Notify.NotificationData.HierarchyTableChange.HierarchyTableChangeUnion.HierarchyRowModifiedNotification.FID ==
+			b->u.mapi_Notify.NotificationData.HierarchyTableChange.HierarchyTableChangeUnion.HierarchyRowModifiedNotification.FID);
+	case 0x8100:
+		ca = &a->u.mapi_Notify.NotificationData.ContentsTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification;
+		cb = &b->u.mapi_Notify.NotificationData.ContentsTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification;
+		break;
+	default:
+		ca = &a->u.mapi_Notify.NotificationData.SearchTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification;
+		cb = &b->u.mapi_Notify.NotificationData.SearchTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification;
+		break;
+	}
+
+	return (ca->FID == cb->FID && ca->MID == cb->MID && ca->Instance == cb->Instance);
+}
+
+/**
+   \details Coalesce the TableModified notifications of a Notify
+   reply array in place.
+
+   Successive TABLE_ROW_MODIFIED notifications on the same row only
+   keep the last one. When a table of a subscription receives
+   threshold events or more, or a TABLE_CHANGED event, all its
+   events are replaced with a single TABLE_CHANGED notification the
+   client answers by reloading the table.
+
+   \param notifications array of Notify replies
+   \param count number of entries in notifications
+   \param threshold number of events on a table from which they are
+   merged into TABLE_CHANGED, 0 to disable
+
+   \return the number of notifications left in the array
+ */
+_PUBLIC_ uint32_t libmapiserver_RopNotify_coalesce(struct EcDoRpc_MAPI_REPL *notifications,
+						   uint32_t count, uint32_t threshold)
+{
+	enum RichTableNotificationType	*event;
+	enum RichTableNotificationType	*other;
+	bool				*drop;
+	bool				changed;
+	uint32_t			events;
+	uint32_t			i, j, k;
+
+	if (!notifications || count < 2) return count;
+
+	drop = talloc_zero_array(NULL, bool, count);
+	if (!drop) return count;
+
+	for (i = 0; i < count; i++) {
+		event = libmapiserver_RopNotify_table_event(&notifications[i]);
+		if (drop[i] || !event) continue;
+
+		events = 0;
+		changed = false;
+		for (j = i; j < count; j++) {
+			other = libmapiserver_RopNotify_table_event(&notifications[j]);
+			if (drop[j] || !other) continue;
+			if (!libmapiserver_RopNotify_same_table(&notifications[i], &notifications[j])) continue;
+			events++;
+			if (*other == TABLE_CHANGED) changed = true;
+		}
+
+		if (changed || (threshold && events >= threshold)) {
+			memset(&notifications[i].u.mapi_Notify.NotificationData, 0, sizeof (union NotificationData));
+			event = libmapiserver_RopNotify_table_event(&notifications[i]);
+			*event = TABLE_CHANGED;
+			for (j = i + 1; j < count; j++) {
+				if (drop[j] || !libmapiserver_RopNotify_table_event(&notifications[j])) continue;
+				if (libmapiserver_RopNotify_same_table(&notifications[i], &notifications[j])) {
+					drop[j] = true;
+				}
+			}
+			continue;
+		}
+
+		/* Only the last modification of a row is worth sending */
+		if (*event == TABLE_ROW_MODIFIED) {
+			for (j = i + 1; j < count; j++) {
+				if (drop[j] || !libmapiserver_RopNotify_table_event(&notifications[j])) continue;
+				if (libmapiserver_RopNotify_same_row(&notifications[i], &notifications[j])) {
+					drop[i] = true;
+					break;
+				}
+			}
+		}
+	}
+
+	for (i = 0, k = 0; i < count; i++) {
+		if (drop[i]) continue;
+		if (k != i) {
+			notifications[k] = notifications[i];
+		}
+		k++;
+	}
+	talloc_free(drop);
+
+	return k;
+}
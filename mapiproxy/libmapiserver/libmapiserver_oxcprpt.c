@@ -386,6 +386,134 @@ _PUBLIC_ uint16_t libmapiserver_RopDeletePropertiesNoReplicate_size(struct EcDoR
 }
 
 
+/**
+   \details Push a NUL terminated UTF-16LE string
+
+   The string is converted straight into the ndr buffer. Strings which
+   aren't valid UTF-8 are left to ndr_push_string, as before.
+
+   \param ndr pointer to the ndr push context
+   \param str the UTF-8 string to push
+ */
+_PUBLIC_ void libmapiserver_push_unicode(struct ndr_push *ndr, const char *str)
+{
+	uint32_t	flags = ndr->flags;
+	size_t		length;
+	ssize_t		len;
+
+	length = strlen(str);
+	if (ndr_push_expand(ndr, length * 2 + 2) == NDR_ERR_SUCCESS) {
+		len = mapi_utf8_to_utf16(str, length, ndr->data + ndr->offset);
+		if (len >= 0) {
+			ndr->data[ndr->offset + len] = 0;
+			ndr->data[ndr->offset + len + 1] = 0;
+			ndr->offset += len + 2;
+			return;
+		}
+	}
+
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_STR_NULLTERM);
+	ndr_push_string(ndr, NDR_SCALARS, str);
+	ndr->flags = flags;
+}
+
+
+/**
+   \details Push a property value in the PropertyRow format
+
+   \param ndr pointer to the ndr push context
+   \param property the property tag
+   \param value generic pointer on the property value
+ */
+static void libmapiserver_push_property_value(struct ndr_push *ndr,
+					      uint32_t property,
+					      const void *value)
+{
+        struct SBinary_short    bin;
+        struct BinaryArray_r    *bin_array;
+	struct mapi_SLPSTRArrayW	*mv_unicode;
+	uint32_t		flags = ndr->flags;
+	uint32_t		i;
+
+	switch (property & 0xFFFF) {
+	case PT_I2:
+		ndr_push_uint16(ndr, NDR_SCALARS, *(uint16_t *) value);
+		break;
+	case PT_LONG:
+	case PT_ERROR:
+	case PT_OBJECT:
+		ndr_push_uint32(ndr, NDR_SCALARS, *(uint32_t *) value);
+		break;
+	case PT_DOUBLE:
+		ndr_push_double(ndr, NDR_SCALARS, *(double *) value);
+		break;
+	case PT_I8:
+		ndr_push_dlong(ndr, NDR_SCALARS, *(uint64_t *) value);
+		break;
+	case PT_BOOLEAN:
+		ndr_push_uint8(ndr, NDR_SCALARS, *(uint8_t *) value);
+		break;
+	case PT_STRING8:
+		ndr_set_flags(&ndr->flags, LIBNDR_FLAG_STR_NULLTERM|LIBNDR_FLAG_STR_ASCII);
+		ndr_push_string(ndr, NDR_SCALARS, (char *) value);
+		break;
+	case PT_UNICODE:
+		libmapiserver_push_unicode(ndr, (const char *) value);
+		break;
+	case PT_BINARY:
+	case PT_SVREID:
+                /* PropertyRow expect a 16 bit header for BLOB in RopQueryRows and RopGetPropertiesSpecific */
+		bin.cb = ((struct Binary_r *) value)->cb;
+		bin.lpb = ((struct Binary_r *) value)->lpb;
+		ndr_push_SBinary_short(ndr, NDR_SCALARS, &bin);
+		break;
+	case PT_CLSID:
+		ndr_push_GUID(ndr, NDR_SCALARS, (struct GUID *) value);
+		break;
+	case PT_SYSTIME:
+		ndr_push_FILETIME(ndr, NDR_SCALARS, (struct FILETIME *) value);
+		break;
+	case PT_SRESTRICT:
+	case PT_ACTIONS:
+		/* value points to the mapi_SPropValue_CTR union */
+		ndr_push_set_switch_value(ndr, value, property & 0xFFFF);
+		ndr_push_mapi_SPropValue_CTR(ndr, NDR_SCALARS, (const union mapi_SPropValue_CTR *) value);
+		break;
+
+	case PT_MV_LONG:
+		ndr_push_mapi_MV_LONG_STRUCT(ndr, NDR_SCALARS, (struct mapi_MV_LONG_STRUCT *) value);
+		break;
+
+	case PT_MV_UNICODE:
+		mv_unicode = (struct mapi_SLPSTRArrayW *) value;
+		ndr_push_uint32(ndr, NDR_SCALARS, mv_unicode->cValues);
+		for (i = 0; i < mv_unicode->cValues; i++) {
+			libmapiserver_push_unicode(ndr, mv_unicode->strings[i].lppszW);
+		}
+		break;
+
+	case PT_MV_BINARY:
+		bin_array = (struct BinaryArray_r *) value;
+		ndr_push_uint32(ndr, NDR_SCALARS, bin_array->cValues);
+		for (i = 0; i < bin_array->cValues; i++) {
+			bin.cb = bin_array->lpbin[i].cb;
+			bin.lpb = bin_array->lpbin[i].lpb;
+			ndr_push_SBinary_short(ndr, NDR_SCALARS, &bin);
+		}
+		break;
+	default:
+		if (property != 0) {
+			OC_DEBUG(5, "unsupported type: %.4x", (property & 0xffff));
+			abort();
+		}
+		break;
+	}
+
+	/* string flags must not leak to the next value of the row */
+	ndr->flags = flags;
+}
+
+
 /**
    \details Add a property value to a DATA blob. This convenient
    function should be used when creating a GetPropertiesSpecific reply
@@ -414,10 +542,7 @@ _PUBLIC_ int libmapiserver_push_property(TALLOC_CTX *mem_ctx,
 					 uint8_t untyped)
 {
 	struct ndr_push		*ndr;
-        struct SBinary_short    bin;
-        struct BinaryArray_r    *bin_array;
-	uint32_t		i;
-	
+
 	ndr = ndr_push_init_ctx(mem_ctx);
 	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
 	ndr->offset = 0;
@@ -465,72 +590,170 @@ _PUBLIC_ int libmapiserver_push_property(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Step 3. Push property data if supported */
+	libmapiserver_push_property_value(ndr, property, value);
+end:
+	/* Step 4. Steal ndr context */
+	blob->data = ndr->data;
+	talloc_steal(mem_ctx, blob->data);
+	blob->length = ndr->offset;
+
+	talloc_free(ndr);
+	return 0;
+}
+
+
+/**
+   \details Return the size of a property value in the PropertyRow
+   format, or 0 when it is left to the generic path to grow the blob
+
+   Unicode strings are sized from their UTF-8 length, which is exact
+   for the common ASCII case.
+ */
+static uint32_t libmapiserver_property_value_size(uint32_t property, const void *value)
+{
 	switch (property & 0xFFFF) {
+	case PT_BOOLEAN:
+		return 1;
 	case PT_I2:
-		ndr_push_uint16(ndr, NDR_SCALARS, *(uint16_t *) value);
-		break;
+		return 2;
 	case PT_LONG:
 	case PT_ERROR:
 	case PT_OBJECT:
-		ndr_push_uint32(ndr, NDR_SCALARS, *(uint32_t *) value);
-		break;
+		return 4;
 	case PT_DOUBLE:
-		ndr_push_double(ndr, NDR_SCALARS, *(double *) value);
-		break;
 	case PT_I8:
-		ndr_push_dlong(ndr, NDR_SCALARS, *(uint64_t *) value);
-		break;
-	case PT_BOOLEAN:
-		ndr_push_uint8(ndr, NDR_SCALARS, *(uint8_t *) value);
-		break;
+	case PT_SYSTIME:
+		return 8;
+	case PT_CLSID:
+		return 16;
 	case PT_STRING8:
-		ndr_set_flags(&ndr->flags, LIBNDR_FLAG_STR_NULLTERM|LIBNDR_FLAG_STR_ASCII);
-		ndr_push_string(ndr, NDR_SCALARS, (char *) value);
-		break;
+		return strlen((const char *) value) + 1;
 	case PT_UNICODE:
-		ndr_set_flags(&ndr->flags, LIBNDR_FLAG_STR_NULLTERM);
-		ndr_push_string(ndr, NDR_SCALARS, (char *) value);
-		break;
+		return strlen((const char *) value) * 2 + 2;
 	case PT_BINARY:
 	case PT_SVREID:
-                /* PropertyRow expect a 16 bit header for BLOB in RopQueryRows and RopGetPropertiesSpecific */
-		bin.cb = ((struct Binary_r *) value)->cb;
-		bin.lpb = ((struct Binary_r *) value)->lpb;
-		ndr_push_SBinary_short(ndr, NDR_SCALARS, &bin);
-		break;
-	case PT_CLSID:
-		ndr_push_GUID(ndr, NDR_SCALARS, (struct GUID *) value);
-		break;
-	case PT_SYSTIME:
-		ndr_push_FILETIME(ndr, NDR_SCALARS, (struct FILETIME *) value);
-		break;
+		return 2 + ((const struct Binary_r *) value)->cb;
+	default:
+		return 0;
+	}
+}
 
-	case PT_MV_LONG:
-		ndr_push_mapi_MV_LONG_STRUCT(ndr, NDR_SCALARS, (struct mapi_MV_LONG_STRUCT *) value);
-		break;
 
-	case PT_MV_UNICODE:
-                ndr_push_mapi_SLPSTRArrayW(ndr, NDR_SCALARS, (struct mapi_SLPSTRArrayW *) value);
-		break;
+/**
+   \details Add a row of property values to a DATA blob, as
+   RopQueryRows and RopGetPropertiesSpecific replies carry them.
 
-	case PT_MV_BINARY:
-		bin_array = (struct BinaryArray_r *) value;
-		ndr_push_uint32(ndr, NDR_SCALARS, bin_array->cValues);
-		for (i = 0; i < bin_array->cValues; i++) {
-			bin.cb = bin_array->lpbin[i].cb;
-			bin.lpb = bin_array->lpbin[i].lpb;
-			ndr_push_SBinary_short(ndr, NDR_SCALARS, &bin);
+   This produces the same bytes as calling libmapiserver_push_property
+   on each property with layout set to PT_ERROR when flagged, but uses
+   a single ndr context for the whole row, reserves the row size once
+   and pushes fixed width values directly. Other types go through the
+   generic path.
+
+   \param mem_ctx pointer to the memory context
+   \param blob the data blob the row is appended to
+   \param count the number of properties
+   \param properties the property tags
+   \param values generic pointers on the property values
+   \param retvals the status of each property; properties which are
+   not MAPI_E_SUCCESS are pushed as PT_ERROR with the status as value
+   \param untyped the untyped status of each property, or NULL
+   \param flagged define if the row is flagged or not
+   \param row_flag whether the row is prefixed by its flagged byte, as
+   in the rows of a table
+
+   \return 0 on success, otherwise -1
+ */
+_PUBLIC_ int libmapiserver_push_property_row(TALLOC_CTX *mem_ctx,
+					     DATA_BLOB *blob,
+					     uint16_t count,
+					     const enum MAPITAGS *properties,
+					     void **values,
+					     const enum MAPISTATUS *retvals,
+					     const bool *untyped,
+					     uint8_t flagged,
+					     bool row_flag)
+{
+	struct ndr_push		*ndr;
+	uint32_t		property;
+	uint32_t		retval;
+	uint32_t		size;
+	const void		*value;
+	uint16_t		i;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	if (!ndr) return -1;
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	if (blob->length) {
+		talloc_free(ndr->data);
+		ndr->data = blob->data;
+		ndr->alloc_size = talloc_get_size(blob->data);
+		ndr->offset = blob->length;
+	}
+
+	/* Reserve the whole row at once */
+	size = row_flag ? 1 : 0;
+	for (i = 0; i < count; i++) {
+		if (untyped && untyped[i]) size += 2;
+		if (flagged) size += 1;
+		if (retvals[i] != MAPI_E_SUCCESS) {
+			size += 4;
 		}
-		break;
-	default:
-		if (property != 0) {
-			OC_DEBUG(5, "unsupported type: %.4x", (property & 0xffff));
-			abort();
+		else {
+			size += libmapiserver_property_value_size(properties[i], values[i]);
 		}
-		break;
 	}
-end:
-	/* Step 4. Steal ndr context */
+	if (ndr_push_expand(ndr, size) != NDR_ERR_SUCCESS) {
+		talloc_free(ndr);
+		return -1;
+	}
+
+	if (row_flag) {
+		ndr_push_uint8(ndr, NDR_SCALARS, flagged);
+	}
+
+	for (i = 0; i < count; i++) {
+		retval = retvals[i];
+		if (retval != MAPI_E_SUCCESS) {
+			property = (properties[i] & 0xFFFF0000) + PT_ERROR;
+			value = &retval;
+		}
+		else {
+			property = properties[i];
+			value = values[i];
+		}
+
+		if (untyped && untyped[i]) {
+			ndr_push_uint16(ndr, NDR_SCALARS, property & 0xFFFF);
+		}
+		if (flagged) {
+			ndr_push_uint8(ndr, NDR_SCALARS, ((property & 0xFFFF) == PT_ERROR) ? PT_ERROR : 0x0);
+		}
+
+		switch (property & 0xFFFF) {
+		case PT_BOOLEAN:
+			ndr_push_uint8(ndr, NDR_SCALARS, *(const uint8_t *) value);
+			break;
+		case PT_I2:
+			ndr_push_uint16(ndr, NDR_SCALARS, *(const uint16_t *) value);
+			break;
+		case PT_LONG:
+		case PT_ERROR:
+		case PT_OBJECT:
+			ndr_push_uint32(ndr, NDR_SCALARS, *(const uint32_t *) value);
+			break;
+		case PT_I8:
+			ndr_push_dlong(ndr, NDR_SCALARS, *(const uint64_t *) value);
+			break;
+		case PT_SYSTIME:
+			ndr_push_uint32(ndr, NDR_SCALARS, ((const struct FILETIME *) value)->dwLowDateTime);
+			ndr_push_uint32(ndr, NDR_SCALARS, ((const struct FILETIME *) value)->dwHighDateTime);
+			break;
+		default:
+			libmapiserver_push_property_value(ndr, property, value);
+			break;
+		}
+	}
+
 	blob->data = ndr->data;
 	talloc_steal(mem_ctx, blob->data);
 	blob->length = ndr->offset;
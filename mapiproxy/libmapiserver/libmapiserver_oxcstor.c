@@ -248,3 +248,24 @@ _PUBLIC_ uint16_t libmapiserver_RopGetReceiveFolderTable_size(struct EcDoRpc_MAP
 
 	return size;
 }
+
+/**
+   \details Calculate Backoff ROP size
+
+   \param response pointer to the Backoff EcDoRpc_MAPI_REPL structure
+
+   \return Size of Backoff response
+ */
+_PUBLIC_ uint16_t libmapiserver_RopBackoff_size(struct EcDoRpc_MAPI_REPL *response)
+{
+	uint16_t	size = SIZE_DFLT_ROPBACKOFF;
+
+	if (!response) {
+		return size;
+	}
+
+	size += response->u.mapi_Backoff.BackoffRopCount * SIZE_DFLT_BACKOFFROP;
+	size += response->u.mapi_Backoff.AdditionalDataSize;
+
+	return size;
+}
@@ -39,69 +39,149 @@
 
 #define MYSQL(context)	((MYSQL *)context->data)
 
+/* Maximum number of FMIDs sent within a single batched statement */
+#define INDEXING_MYSQL_BATCH_SIZE	256
+
+
+/* Cache keys are a type byte followed by fixed-size binary fields:
+   the hash of a URI maps to its FMID, the hash of a username and a
+   FMID map to its URI. Integers are stored little-endian. */
+#define	INDEXING_MEMCACHED_URI_KEY	'U'
+#define	INDEXING_MEMCACHED_FMID_KEY	'F'
+#define	INDEXING_MEMCACHED_URI_KEY_LEN	9
+#define	INDEXING_MEMCACHED_FMID_KEY_LEN	17
+
+enum indexing_memcached_op {
+	INDEXING_MEMCACHED_ADD,
+	INDEXING_MEMCACHED_SET,
+	INDEXING_MEMCACHED_DELETE
+};
+
+/* memcached connection shared by the indexing contexts of the process
+   using the same servers */
+struct indexing_memcached_server {
+	struct indexing_memcached_server	*prev;
+	struct indexing_memcached_server	*next;
+	char					*conn_str;
+	memcached_st				*memc;
+	uint32_t				ref_count;
+};
+
+/* Cache of an indexing context, attached to its server on first use */
+struct indexing_memcached {
+	struct indexing_memcached_server	*server;
+	char					*conn_str;
+	bool					setup;
+};
+
+static struct indexing_memcached_server	*memcached_servers = NULL;
+
+static void _memcached_put_uint64(char *p, uint64_t value)
+{
+	int	i;
+
+	for (i = 0; i < 8; i++) {
+		p[i] = (value >> (8 * i)) & 0xFF;
+	}
+}
+
+static uint64_t _memcached_get_uint64(const char *p)
+{
+	uint64_t	value = 0;
+	int		i;
+
+	for (i = 0; i < 8; i++) {
+		value |= (uint64_t)(uint8_t)p[i] << (8 * i);
+	}
+	return value;
+}
+
 
 /**
-   \details Generate key for FMID cache
+   \details Generate the key mapping a URI to its FMID
 
-   \param mem_ctx pointer to the memory context
+   \param key buffer of INDEXING_MEMCACHED_URI_KEY_LEN bytes
    \param uri pointer to the uri to use for hashing
+ */
+static void _memcached_uri_key(char *key, const char *uri)
+{
+	key[0] = INDEXING_MEMCACHED_URI_KEY;
+	_memcached_put_uint64(key + 1, hash64_stable(uri, strlen(uri), 0));
+}
 
-   \return String allocated with TALLOC on success, otherwise NULL
+
+/**
+   \details Generate the key mapping a FMID to its URI
+
+   \param key buffer of INDEXING_MEMCACHED_FMID_KEY_LEN bytes
+   \param username the user owning the FMID
+   \param fmid the FMID
  */
-static char *_memcached_gen_key(TALLOC_CTX *mem_ctx, const char *uri)
+static void _memcached_fmid_key(char *key, const char *username, uint64_t fmid)
 {
-	return talloc_asprintf(mem_ctx, "%"PRIx64, hash64((void *)uri, strlen(uri), 0));
+	key[0] = INDEXING_MEMCACHED_FMID_KEY;
+	_memcached_put_uint64(key + 1, hash64_stable(username, strlen(username), 0));
+	_memcached_put_uint64(key + 9, fmid);
 }
 
 
 /**
-   \details Generate value for FMID cache
+   \details Add, replace or delete both cache records of a FMID
 
-   \param mem_ctx pointer to the memory context
-   \param fmid the fmid to convert
+   \param memc pointer to the memcached context
+   \param op the operation to perform
+   \param username the user owning the FMID
+   \param fmid the FMID
+   \param uri the URI of the FMID
 
-   \return String allocated with TALLOC on success, otherwise NULL
+   \return MEMCACHED_SUCCESS or MEMCACHED_BUFFERED on success,
+   otherwise the first memcached error
  */
-static char *_memcached_gen_value(TALLOC_CTX *mem_ctx, uint64_t fmid)
+static memcached_return_t _memcached_store(memcached_st *memc, enum indexing_memcached_op op,
+					   const char *username, uint64_t fmid, const char *uri)
 {
-	return talloc_asprintf(mem_ctx, "%"PRIu64, fmid);
+	char			uri_key[INDEXING_MEMCACHED_URI_KEY_LEN];
+	char			fmid_key[INDEXING_MEMCACHED_FMID_KEY_LEN];
+	char			value[8];
+	memcached_return_t	rc, rc2;
+
+	_memcached_uri_key(uri_key, uri);
+	_memcached_fmid_key(fmid_key, username, fmid);
+	_memcached_put_uint64(value, fmid);
+
+	switch (op) {
+	case INDEXING_MEMCACHED_ADD:
+		rc = memcached_add(memc, uri_key, sizeof(uri_key), value, sizeof(value), 0, 0);
+		rc2 = memcached_add(memc, fmid_key, sizeof(fmid_key), uri, strlen(uri), 0, 0);
+		break;
+	case INDEXING_MEMCACHED_SET:
+		rc = memcached_set(memc, uri_key, sizeof(uri_key), value, sizeof(value), 0, 0);
+		rc2 = memcached_set(memc, fmid_key, sizeof(fmid_key), uri, strlen(uri), 0, 0);
+		break;
+	default:
+		rc = memcached_delete(memc, uri_key, sizeof(uri_key), 0);
+		rc2 = memcached_delete(memc, fmid_key, sizeof(fmid_key), 0);
+		break;
+	}
+
+	return (rc == MEMCACHED_SUCCESS || rc == MEMCACHED_BUFFERED) ? rc2 : rc;
 }
 
 
 /**
-   \details Prepare FMID cache for specified user
+   \details Open a memcached connection
 
-   \param ictx valid pointer to the indexing context
    \param conn_str connection string to memcached server
-   \param username name of the user for to create the FMID cache for
 
-   \note Fallback to 127.0.0.1:11211 if server_string is missing
+   \note Fallback to 127.0.0.1:11211 if conn_str is missing
 
    \return valid memcached_st pointer on success, otherwise NULL
  */
-static memcached_st *_memcached_setup(struct indexing_context *ictx,
-				      const char *conn_str,
-				      const char *username)
+static memcached_st *_memcached_connect(const char *conn_str)
 {
-	TALLOC_CTX		*mem_ctx;
-	char			*sql;
-	int			mret;
-	MYSQL_RES		*res;
-	uint32_t		num_rows = 0;
 	memcached_server_st	*servers = NULL;
 	memcached_st		*memc = NULL;
 	memcached_return	rc;
-	uint32_t		i;
-
-	OC_DEBUG(5, "[INFO] _memcached_setup for '%s'\n", username);
-
-	/* Sanity checks */
-	if (!ictx) return NULL;
-	if (!username) return NULL;
-
-	if (ictx->cache != NULL) {
-		return ictx->cache;
-	}
 
 	/* Initialize memcached connection */
 	if (conn_str) {
@@ -113,14 +193,112 @@ static memcached_st *_memcached_setup(struct indexing_context *ictx,
 
 		servers = memcached_server_list_append(servers, "127.0.0.1", 11211, &rc);
 		rc = memcached_server_push(memc, servers);
+		memcached_server_list_free(servers);
 		if (rc != MEMCACHED_SUCCESS) {
 			OC_DEBUG(0, "[ERR]: Unable to add server to memcached list\n");
+			memcached_free(memc);
+			return NULL;
+		}
+	}
+
+	/* Binary keys need the binary protocol. Consistent hashing
+	   keeps most keys on their server when the list changes */
+	rc = memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
+	if (rc == MEMCACHED_SUCCESS) {
+		rc = memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_KETAMA_WEIGHTED, 1);
+	}
+	if (rc != MEMCACHED_SUCCESS) {
+		OC_DEBUG(0, "[ERR]: Unable to configure memcached: %s\n", memcached_strerror(memc, rc));
+		memcached_free(memc);
+		return NULL;
+	}
+
+	return memc;
+}
+
+
+static int _memcached_server_destructor(struct indexing_memcached_server *server)
+{
+	DLIST_REMOVE(memcached_servers, server);
+	memcached_free(server->memc);
+	return 0;
+}
+
+
+/**
+   \details Return the memcached connection of the process for a
+   connection string, opening it if none exists yet
+
+   \param conn_str connection string to memcached server, NULL for the
+   default server
+
+   \return pointer to the shared connection on success, otherwise NULL
+ */
+static struct indexing_memcached_server *_memcached_server_get(const char *conn_str)
+{
+	struct indexing_memcached_server	*server;
+
+	for (server = memcached_servers; server; server = server->next) {
+		if ((!conn_str && !server->conn_str) ||
+		    (conn_str && server->conn_str && !strcmp(conn_str, server->conn_str))) {
+			server->ref_count++;
+			return server;
+		}
+	}
+
+	server = talloc_zero(NULL, struct indexing_memcached_server);
+	if (!server) return NULL;
+	if (conn_str) {
+		server->conn_str = talloc_strdup(server, conn_str);
+		if (!server->conn_str) {
+			talloc_free(server);
 			return NULL;
 		}
 	}
+	server->memc = _memcached_connect(conn_str);
+	if (!server->memc) {
+		talloc_free(server);
+		return NULL;
+	}
+	server->ref_count = 1;
+	talloc_set_destructor(server, _memcached_server_destructor);
+	DLIST_ADD(memcached_servers, server);
+
+	return server;
+}
+
+
+static int _memcached_destructor(struct indexing_memcached *cache)
+{
+	if (cache->server && --cache->server->ref_count == 0) {
+		talloc_free(cache->server);
+	}
+	return 0;
+}
+
+
+/**
+   \details Load the indexing records of a user into the cache database
+
+   \param ictx valid pointer to the indexing context
+   \param memc pointer to the memcached connection
+   \param username name of the user to load the records of
+ */
+static void _memcached_preload(struct indexing_context *ictx, memcached_st *memc,
+			       const char *username)
+{
+	TALLOC_CTX		*mem_ctx;
+	char			*sql;
+	int			mret;
+	MYSQL_RES		*res;
+	uint32_t		num_rows = 0;
+	memcached_return	rc;
+	uint64_t		buffered;
+	uint32_t		i;
+
 	/* Retrieve indexing records for user */
 	mem_ctx = talloc_new(NULL);
-	if (!mem_ctx) return NULL;
+	if (!mem_ctx) return;
 
 	sql = talloc_asprintf(mem_ctx, "SELECT fmid,url FROM "INDEXING_TABLE" "
 			      "WHERE username = '%s' AND soft_deleted = '%d'",
@@ -129,34 +307,94 @@ static memcached_st *_memcached_setup(struct indexing_context *ictx,
 	mret = select_without_fetch(MYSQL(ictx), sql, &res);
 	if (mret != MYSQL_SUCCESS) {
 		talloc_free(mem_ctx);
-		return NULL;
+		return;
 	}
 
 	num_rows = mysql_num_rows(res);
-	OC_DEBUG(5, "[INFO] _memcached_setup: %d values to index\n", num_rows);
+	OC_DEBUG(5, "[INFO] _memcached_preload: %d values to index\n", num_rows);
 
 	/* store records into memcached */
+	buffered = memcached_behavior_get(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS);
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
 	for (i = 0; i < num_rows; i++) {
 		MYSQL_ROW row = mysql_fetch_row(res);
 
 		if (row) {
-			char *hashstr = NULL;
-
-			hashstr = _memcached_gen_key(mem_ctx, row[1]);
-			if (hashstr) {
-				rc = memcached_add(memc, hashstr, strlen(hashstr),
-						   row[0], strlen(row[0]), 0, 0);
-				talloc_free(hashstr);
-				if (rc != MEMCACHED_SUCCESS) {
-					OC_DEBUG(8, "[ERR] Key %s not stored\n", row[1]);
-				}
+			rc = _memcached_store(memc, INDEXING_MEMCACHED_ADD, username,
+					      strtoull(row[0], NULL, 0), row[1]);
+			if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED) {
+				OC_DEBUG(8, "[ERR] Key %s not stored\n", row[1]);
 			}
 		}
 	}
+	memcached_flush_buffers(memc);
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, buffered);
 
 	mysql_free_result(res);
 	talloc_free(mem_ctx);
-	return memc;
+}
+
+
+/**
+   \details Prepare FMID cache for specified user
+
+   The cache is only attached to the memcached connection the process
+   shares for its servers, and filled with the records of the user,
+   when the indexing context first needs it.
+
+   \param ictx valid pointer to the indexing context
+   \param conn_str connection string to memcached server, NULL for the
+   default server
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error _memcached_setup(struct indexing_context *ictx,
+					     const char *conn_str)
+{
+	struct indexing_memcached	*cache;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(ictx->cache, MAPISTORE_SUCCESS, NULL);
+
+	cache = talloc_zero(ictx, struct indexing_memcached);
+	MAPISTORE_RETVAL_IF(!cache, MAPISTORE_ERR_NO_MEMORY, NULL);
+	if (conn_str) {
+		cache->conn_str = talloc_strdup(cache, conn_str);
+		MAPISTORE_RETVAL_IF(!cache->conn_str, MAPISTORE_ERR_NO_MEMORY, cache);
+	}
+	talloc_set_destructor(cache, _memcached_destructor);
+
+	ictx->cache = cache;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Return the memcached connection of an indexing context,
+   attaching it on first use
+
+   \param ictx valid pointer to the indexing context
+
+   \return valid memcached_st pointer, NULL if the cache is unavailable
+ */
+static memcached_st *_memcached(struct indexing_context *ictx)
+{
+	struct indexing_memcached	*cache = ictx->cache;
+
+	if (!cache) return NULL;
+
+	if (!cache->setup) {
+		cache->setup = true;
+		OC_DEBUG(5, "[INFO] attaching memcached to the indexing context of '%s'\n", ictx->url);
+		cache->server = _memcached_server_get(cache->conn_str);
+		if (cache->server) {
+			_memcached_preload(ictx, cache->server->memc, ictx->url);
+		}
+	}
+
+	return cache->server ? cache->server->memc : NULL;
 }
 
 
@@ -172,37 +410,109 @@ static memcached_st *_memcached_setup(struct indexing_context *ictx,
 static enum mapistore_error _memcached_get_record(struct indexing_context *ictx,
 						  const char *uri, uint64_t *fmid)
 {
-	TALLOC_CTX		*mem_ctx;
 	memcached_st		*memc;
 	memcached_return_t	error;
 	uint32_t		flags;
-	uint64_t		_fmid = 0;
-	char			*key;
+	char			key[INDEXING_MEMCACHED_URI_KEY_LEN];
 	char			*value;
 	size_t			value_len;
-	bool			bret = false;
+	bool			valid;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
-	MAPISTORE_RETVAL_IF(!ictx->cache, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!uri, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!fmid, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
-	mem_ctx = talloc_new(NULL);
-	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+	memc = _memcached(ictx);
+	MAPISTORE_RETVAL_IF(!memc, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
-	key = _memcached_gen_key(mem_ctx, uri);
-	MAPISTORE_RETVAL_IF(!key, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	_memcached_uri_key(key, uri);
+	value = memcached_get(memc, key, sizeof(key), &value_len, &flags, &error);
+	MAPISTORE_RETVAL_IF(!value, MAPISTORE_ERROR, NULL);
 
-	memc = ictx->cache;
-	value = memcached_get(memc, key, strlen(key), &value_len, &flags, &error);
-	MAPISTORE_RETVAL_IF(!value, MAPISTORE_ERROR, mem_ctx);
+	valid = (value_len == 8);
+	if (valid) {
+		*fmid = _memcached_get_uint64(value);
+	}
+	free(value);
 
-	bret = convert_string_to_ull(value, &_fmid);
-	MAPISTORE_RETVAL_IF(!bret, MAPISTORE_ERROR, mem_ctx);
-	*fmid = _fmid;
+	return valid ? MAPISTORE_SUCCESS : MAPISTORE_ERROR;
+}
 
-	talloc_free(mem_ctx);
+
+/**
+   \details Retrieve the URIs of a set of FMIDs from the cache database
+   with a single multi-get
+
+   \param ictx valid pointer to the indexing context
+   \param username the user owning the FMIDs
+   \param mem_ctx pointer to the memory context the URIs are allocated
+   with
+   \param count number of FMIDs
+   \param fmids array of FMIDs
+   \param uris array of count elements, where the URIs found are
+   stored. Elements already set are left untouched
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE_ERROR
+ */
+static enum mapistore_error _memcached_get_uris(struct indexing_context *ictx,
+						const char *username,
+						TALLOC_CTX *mem_ctx,
+						uint32_t count,
+						const uint64_t *fmids,
+						char **uris)
+{
+	TALLOC_CTX		*local_mem_ctx;
+	memcached_st		*memc;
+	memcached_result_st	*result;
+	memcached_return_t	rc;
+	char			*key_data;
+	const char		**keys;
+	size_t			*keys_len;
+	const char		*key;
+	uint64_t		fmid;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	memc = _memcached(ictx);
+	MAPISTORE_RETVAL_IF(!memc, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	key_data = talloc_array(local_mem_ctx, char, count * INDEXING_MEMCACHED_FMID_KEY_LEN);
+	keys = talloc_array(local_mem_ctx, const char *, count);
+	keys_len = talloc_array(local_mem_ctx, size_t, count);
+	MAPISTORE_RETVAL_IF(!key_data || !keys || !keys_len, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+
+	for (i = 0; i < count; i++) {
+		keys[i] = key_data + i * INDEXING_MEMCACHED_FMID_KEY_LEN;
+		keys_len[i] = INDEXING_MEMCACHED_FMID_KEY_LEN;
+		_memcached_fmid_key((char *)keys[i], username, fmids[i]);
+	}
+
+	rc = memcached_mget(memc, keys, keys_len, count);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, local_mem_ctx);
+
+	while ((result = memcached_fetch_result(memc, NULL, &rc)) != NULL) {
+		key = memcached_result_key_value(result);
+		if (memcached_result_key_length(result) == INDEXING_MEMCACHED_FMID_KEY_LEN) {
+			fmid = _memcached_get_uint64(key + 9);
+			for (i = 0; i < count; i++) {
+				if (fmids[i] == fmid && !uris[i]) {
+					uris[i] = talloc_strndup(mem_ctx, memcached_result_value(result),
+								 memcached_result_length(result));
+				}
+			}
+		}
+		memcached_result_free(result);
+	}
+
+	talloc_free(local_mem_ctx);
 	return MAPISTORE_SUCCESS;
 }
 
@@ -211,41 +521,30 @@ static enum mapistore_error _memcached_get_record(struct indexing_context *ictx,
    \details Add record to the cache database
 
    \param ictx valid pointer to the indexing context
-   \param uri pointer to the uri used to hash the key
-   \param fmid the value of the key/value pair
+   \param username the user owning the FMID
+   \param uri the URI of the FMID
+   \param fmid the FMID
 
    \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE_ERROR
  */
 static enum mapistore_error _memcached_add_record(struct indexing_context *ictx,
+						  const char *username,
 						  const char *uri, uint64_t fmid)
 {
-	TALLOC_CTX		*mem_ctx;
 	memcached_st		*memc;
 	memcached_return_t	rc;
-	char			*key;
-	char			*value;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!uri, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Return MAPISTORE_SUCCESS if cache is not configured */
-	MAPISTORE_RETVAL_IF(!ictx->cache, MAPISTORE_SUCCESS, NULL);
-
-	mem_ctx = talloc_new(NULL);
-	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
-
-	key = _memcached_gen_key(mem_ctx, uri);
-	MAPISTORE_RETVAL_IF(!key, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-
-	value = _memcached_gen_value(mem_ctx, fmid);
-	MAPISTORE_RETVAL_IF(!value, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	memc = _memcached(ictx);
+	MAPISTORE_RETVAL_IF(!memc, MAPISTORE_SUCCESS, NULL);
 
-	memc = (memcached_st *)ictx->cache;
-	rc = memcached_add(memc, key, strlen(key), value, strlen(value), 0, 0);
-	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, mem_ctx);
+	rc = _memcached_store(memc, INDEXING_MEMCACHED_ADD, username, fmid, uri);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, NULL);
 
-	talloc_free(mem_ctx);
 	return MAPISTORE_SUCCESS;
 }
 
@@ -254,81 +553,145 @@ static enum mapistore_error _memcached_add_record(struct indexing_context *ictx,
    \details Update record in the cache database
 
    \param ictx valid pointer to the indexing context
-   \param uri pointer to the uri used to hash the key
-   \param fmid the value of the key/value pair
+   \param username the user owning the FMID
+   \param uri the new URI of the FMID
+   \param fmid the FMID
 
    \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE_ERROR
  */
 static enum mapistore_error _memcached_update_record(struct indexing_context *ictx,
+						     const char *username,
 						     const char *uri, uint64_t fmid)
 {
-	TALLOC_CTX		*mem_ctx;
 	memcached_st		*memc;
 	memcached_return_t	rc;
-	char			*key;
-	char			*value;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!uri, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Return MAPISTORE_SUCCESS if cache is not configured */
-	MAPISTORE_RETVAL_IF(!ictx->cache, MAPISTORE_SUCCESS, NULL);
-
-	mem_ctx = talloc_new(NULL);
-	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	memc = _memcached(ictx);
+	MAPISTORE_RETVAL_IF(!memc, MAPISTORE_SUCCESS, NULL);
 
-	key = _memcached_gen_key(mem_ctx, uri);
-	MAPISTORE_RETVAL_IF(!key, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	rc = _memcached_store(memc, INDEXING_MEMCACHED_SET, username, fmid, uri);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, NULL);
 
-	value = _memcached_gen_value(mem_ctx, fmid);
-	MAPISTORE_RETVAL_IF(!value, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-
-	memc = (memcached_st *)ictx->cache;
-	rc = memcached_set(memc, key, strlen(key), value, strlen(value), 0, 0);
-	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, mem_ctx);
-
-	talloc_free(mem_ctx);
 	return MAPISTORE_SUCCESS;
 }
 
 
 /**
-   \details Delte record from the cache database
+   \details Delete record from the cache database
 
    \param ictx valid pointer to the indexing context
-   \param uri pointer to the uri used to hash the key
-   \param fmid the value of the key/value pair
+   \param username the user owning the FMID
+   \param uri the URI of the FMID
+   \param fmid the FMID
 
    \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE_ERROR
  */
 static enum mapistore_error _memcached_delete_record(struct indexing_context *ictx,
-						     const char *uri)
+						     const char *username,
+						     const char *uri, uint64_t fmid)
 {
-	TALLOC_CTX		*mem_ctx;
 	memcached_st		*memc;
 	memcached_return_t	rc;
-	char			*key;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!uri, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Return MAPISTORE_SUCCESS if cache is not configured */
-	MAPISTORE_RETVAL_IF(!ictx->cache, MAPISTORE_SUCCESS, NULL);
+	memc = _memcached(ictx);
+	MAPISTORE_RETVAL_IF(!memc, MAPISTORE_SUCCESS, NULL);
 
-	mem_ctx = talloc_new(NULL);
-	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	rc = _memcached_store(memc, INDEXING_MEMCACHED_DELETE, username, fmid, uri);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, NULL);
 
-	key = _memcached_gen_key(mem_ctx, uri);
-	MAPISTORE_RETVAL_IF(!key, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	return MAPISTORE_SUCCESS;
+}
 
-	memc = (memcached_st *)ictx->cache;
-	rc = memcached_delete(memc, key, strlen(key), 0);
-	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERROR, mem_ctx);
+/**
+   \details Add or delete a set of records in the cache database
+   using a single buffered round-trip
 
-	talloc_free(mem_ctx);
-	return MAPISTORE_SUCCESS;
+   \param ictx valid pointer to the indexing context
+   \param username the user owning the FMIDs
+   \param count number of records
+   \param uris array of uris of the records
+   \param fmids array of FMIDs of the records
+   \param op INDEXING_MEMCACHED_ADD or INDEXING_MEMCACHED_DELETE
+
+   \note Entries with NULL uris are skipped
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE_ERROR
+ */
+static enum mapistore_error _memcached_batch_records(struct indexing_context *ictx,
+						     const char *username,
+						     uint32_t count,
+						     const char **uris,
+						     const uint64_t *fmids,
+						     enum indexing_memcached_op op)
+{
+	memcached_st		*memc;
+	memcached_return_t	rc;
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	uint64_t		buffered;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!uris, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Return MAPISTORE_SUCCESS if cache is not configured */
+	memc = _memcached(ictx);
+	MAPISTORE_RETVAL_IF(!memc, MAPISTORE_SUCCESS, NULL);
+
+	/* Queue all the requests and flush them at once */
+	buffered = memcached_behavior_get(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS);
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, 1);
+
+	for (i = 0; i < count; i++) {
+		if (!uris[i]) continue;
+
+		rc = _memcached_store(memc, op, username, fmids[i], uris[i]);
+		if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_BUFFERED) {
+			retval = MAPISTORE_ERROR;
+		}
+	}
+
+	rc = memcached_flush_buffers(memc);
+	if (rc != MEMCACHED_SUCCESS) {
+		retval = MAPISTORE_ERROR;
+	}
+	memcached_behavior_set(memc, MEMCACHED_BEHAVIOR_BUFFER_REQUESTS, buffered);
+
+	return retval;
+}
+/**
+   \details Build the comma separated list of FMIDs used within IN
+   clauses
+
+   \param mem_ctx pointer to the memory context
+   \param count number of FMIDs
+   \param fmids array of FMIDs
+
+   \return String allocated with TALLOC on success, otherwise NULL
+ */
+static char *_sql_fmid_list(TALLOC_CTX *mem_ctx, uint32_t count, const uint64_t *fmids)
+{
+	char		*list;
+	uint32_t	i;
+
+	list = talloc_strdup(mem_ctx, "");
+	for (i = 0; list && i < count; i++) {
+		list = talloc_asprintf_append(list, "%s'%"PRIu64"'",
+					      i ? ", " : "", fmids[i]);
+	}
+
+	return list;
 }
 
 /**
@@ -415,7 +778,7 @@ static enum mapistore_error mysql_record_add(struct indexing_context *ictx,
 	ret = execute_query(MYSQL(ictx), sql);
 	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
 
-	retval = _memcached_add_record(ictx, mapistore_URI, fmid);
+	retval = _memcached_add_record(ictx, username, mapistore_URI, fmid);
 	if (retval != MAPISTORE_SUCCESS) {
 		OC_DEBUG(0, "[indexing] Failed to add record `%s: %"PRIu64"` on memcached (%s)",
 			 mapistore_URI, fmid, mapistore_errstr(retval));
@@ -475,7 +838,7 @@ static enum mapistore_error mysql_record_update(struct indexing_context *ictx,
 		MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_NOT_FOUND, mem_ctx);
 	}
 
-	retval = _memcached_update_record(ictx, mapistore_URI, fmid);
+	retval = _memcached_update_record(ictx, username, mapistore_URI, fmid);
 	if (retval != MAPISTORE_SUCCESS) {
 		OC_DEBUG(0, "[indexing] Failed to update record `%s` with `%"PRIu64"` on memcached (%s)",
 			 mapistore_URI, fmid, mapistore_errstr(retval));
@@ -519,6 +882,15 @@ static enum mapistore_error mysql_record_get_uri(struct indexing_context *ictx,
 	MAPISTORE_RETVAL_IF(!urip, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!soft_deletedp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
+	/* Records found in the cache are not soft deleted */
+	if (ictx->cache) {
+		*urip = NULL;
+		_memcached_get_uris(ictx, username, mem_ctx, 1, &fmid, urip);
+		if (*urip) {
+			*soft_deletedp = false;
+			return MAPISTORE_SUCCESS;
+		}
+	}
 
 	sql = talloc_asprintf(mem_ctx,
 		"SELECT url, soft_deleted FROM %s "
@@ -607,7 +979,7 @@ static enum mapistore_error mysql_record_del(struct indexing_context *ictx,
 	ret = execute_query(MYSQL(ictx), sql);
 	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
 
-	retval = _memcached_delete_record(ictx, uri);
+	retval = _memcached_delete_record(ictx, username, uri, fmid);
 	if (retval != MAPISTORE_SUCCESS) {
 		OC_DEBUG(0, "[indexing] Failed to delete record `%s` on memcached (%s)",
 			 uri, mapistore_errstr(retval));
@@ -694,6 +1066,368 @@ static enum mapistore_error mysql_record_get_fmid(struct indexing_context *ictx,
 }
 
 
+/**
+  \details Adds a set of FMIDs and related URLs in indexing database
+
+  The records are inserted using multi-row INSERT statements within a
+  single transaction: either all of them are recorded or none is.
+
+  \param ictx valid pointer to indexing context
+  \param username samAccountName for current user
+  \param count number of records to add
+  \param fmids array of FMIDs to record
+  \param uris array of mapistore URI strings to associate with fmids
+
+  \return MAPISTORE_SUCCESS on success,
+	  MAPISTORE_ERR_EXIST if any of the FMIDs already exists
+	  MAPISTORE_ERR_NOT_INITIALIZED if ictx pointer is invalid (NULL)
+	  MAPISTORE_ERR_INVALID_PARAMETER in case other parameters are not valid
+	  MAPISTORE_ERR_DATABASE_OPS in case of MySQL error
+ */
+static enum mapistore_error mysql_record_add_fmids(struct indexing_context *ictx,
+						   const char *username,
+						   uint32_t count,
+						   const uint64_t *fmids,
+						   const char **uris)
+{
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	enum MYSQLRESULT	ret;
+	TALLOC_CTX		*mem_ctx;
+	const char		*_username;
+	char			*sql;
+	char			*list;
+	uint64_t		existing;
+	uint32_t		offset, len, i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !uris, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	for (i = 0; i < count; i++) {
+		MAPISTORE_RETVAL_IF(!fmids[i], MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+		MAPISTORE_RETVAL_IF(!uris[i], MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	}
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_named(NULL, 0, "mysql_record_add_fmids");
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	_username = _sql(mem_ctx, username);
+	MAPISTORE_RETVAL_IF(!_username, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	ret = execute_query(MYSQL(ictx), "START TRANSACTION");
+	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+	for (offset = 0; offset < count; offset += len) {
+		len = count - offset;
+		if (len > INDEXING_MYSQL_BATCH_SIZE) len = INDEXING_MYSQL_BATCH_SIZE;
+
+		/* Check none of the fid/mid already exists within the database */
+		list = _sql_fmid_list(mem_ctx, len, fmids + offset);
+		sql = talloc_asprintf(mem_ctx,
+			"SELECT COUNT(*) FROM %s "
+			"WHERE username = '%s' AND fmid IN (%s)",
+			INDEXING_TABLE, _username, list);
+		if (!list || !sql) {
+			retval = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+
+		ret = select_first_uint(MYSQL(ictx), sql, &existing);
+		if (ret != MYSQL_SUCCESS) {
+			retval = MAPISTORE_ERR_DATABASE_OPS;
+			goto end;
+		}
+		if (existing) {
+			retval = MAPISTORE_ERR_EXIST;
+			goto end;
+		}
+
+		sql = talloc_asprintf(mem_ctx,
+			"INSERT INTO %s "
+			"(username, fmid, url, soft_deleted) VALUES ",
+			INDEXING_TABLE);
+		for (i = offset; sql && i < offset + len; i++) {
+			sql = talloc_asprintf_append(sql, "%s('%s', '%"PRIu64"', '%s', '%d')",
+						     (i == offset) ? "" : ", ",
+						     _username, fmids[i],
+						     _sql(mem_ctx, uris[i]), 0);
+		}
+		if (!sql) {
+			retval = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+
+		ret = execute_query(MYSQL(ictx), sql);
+		if (ret != MYSQL_SUCCESS) {
+			retval = MAPISTORE_ERR_DATABASE_OPS;
+			goto end;
+		}
+	}
+
+	ret = execute_query(MYSQL(ictx), "COMMIT");
+	if (ret != MYSQL_SUCCESS) {
+		retval = MAPISTORE_ERR_DATABASE_OPS;
+		goto end;
+	}
+
+	if (_memcached_batch_records(ictx, username, count, uris, fmids, INDEXING_MEMCACHED_ADD) != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "[indexing] Failed to add %"PRIu32" records on memcached", count);
+	}
+
+end:
+	if (retval != MAPISTORE_SUCCESS) {
+		execute_query(MYSQL(ictx), "ROLLBACK");
+	}
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+
+/**
+  \details Delete a set of FMID mappings from database.
+	   Note that function will succeed for FMIDs which do not exist
+
+  \param ictx valid pointer to indexing context
+  \param username samAccountName for current user
+  \param count number of FMIDs to delete
+  \param fmids array of FMIDs to delete
+  \param flags MAPISTORE_SOFT_DELETE - soft delete the entries,
+	       MAPISTORE_PERMANENT_DELETE - permanently delete
+
+  \return MAPISTORE_SUCCESS on success
+	  MAPISTORE_ERR_NOT_INITIALIZED if ictx pointer is invalid (NULL)
+	  MAPISTORE_ERR_INVALID_PARAMETER in case other parameters are not valid
+	  MAPISTORE_ERR_DATABASE_OPS in case of MySQL error
+ */
+static enum mapistore_error mysql_record_del_fmids(struct indexing_context *ictx,
+						   const char *username,
+						   uint32_t count,
+						   const uint64_t *fmids,
+						   uint8_t flags)
+{
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	enum MYSQLRESULT	ret;
+	TALLOC_CTX		*mem_ctx;
+	MYSQL_RES		*res;
+	MYSQL_ROW		row;
+	const char		*_username;
+	const char		*filter;
+	const char		**uris;
+	uint64_t		*found;
+	char			*sql;
+	char			*list;
+	uint32_t		offset, len, i, num_rows;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(flags != MAPISTORE_SOFT_DELETE &&
+			    flags != MAPISTORE_PERMANENT_DELETE,
+			    MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_named(NULL, 0, "mysql_record_del_fmids");
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	_username = _sql(mem_ctx, username);
+	MAPISTORE_RETVAL_IF(!_username, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	/* nothing to do for records which are already soft deleted */
+	filter = (flags == MAPISTORE_SOFT_DELETE) ? " AND soft_deleted = 0" : "";
+
+	ret = execute_query(MYSQL(ictx), "START TRANSACTION");
+	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+	for (offset = 0; offset < count; offset += len) {
+		len = count - offset;
+		if (len > INDEXING_MYSQL_BATCH_SIZE) len = INDEXING_MYSQL_BATCH_SIZE;
+
+		/* Retrieve the records to remove from the cache */
+		list = _sql_fmid_list(mem_ctx, len, fmids + offset);
+		sql = talloc_asprintf(mem_ctx,
+			"SELECT fmid, url FROM %s "
+			"WHERE username = '%s' AND fmid IN (%s)%s",
+			INDEXING_TABLE, _username, list, filter);
+		if (!list || !sql) {
+			retval = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+
+		ret = select_without_fetch(MYSQL(ictx), sql, &res);
+		if (ret == MYSQL_NOT_FOUND) continue;
+		if (ret != MYSQL_SUCCESS) {
+			retval = MAPISTORE_ERR_DATABASE_OPS;
+			goto end;
+		}
+
+		num_rows = mysql_num_rows(res);
+		uris = talloc_zero_array(mem_ctx, const char *, num_rows);
+		found = talloc_array(mem_ctx, uint64_t, num_rows);
+		for (i = 0; uris && found && i < num_rows; i++) {
+			row = mysql_fetch_row(res);
+			found[i] = strtoull(row[0], NULL, 0);
+			uris[i] = talloc_strdup(uris, row[1]);
+		}
+		mysql_free_result(res);
+		if (!uris || !found) {
+			retval = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+
+		if (flags == MAPISTORE_SOFT_DELETE) {
+			sql = talloc_asprintf(mem_ctx,
+				"UPDATE %s "
+				"SET soft_deleted=1 "
+				"WHERE username = '%s' AND fmid IN (%s)%s",
+				INDEXING_TABLE, _username, list, filter);
+		} else {
+			sql = talloc_asprintf(mem_ctx,
+				"DELETE FROM %s "
+				"WHERE username = '%s' AND fmid IN (%s)",
+				INDEXING_TABLE, _username, list);
+		}
+		if (!sql) {
+			retval = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+
+		ret = execute_query(MYSQL(ictx), sql);
+		if (ret != MYSQL_SUCCESS) {
+			retval = MAPISTORE_ERR_DATABASE_OPS;
+			goto end;
+		}
+
+		if (_memcached_batch_records(ictx, username, num_rows, uris, found, INDEXING_MEMCACHED_DELETE) != MAPISTORE_SUCCESS) {
+			OC_DEBUG(0, "[indexing] Failed to delete %"PRIu32" records on memcached", num_rows);
+		}
+	}
+
+	ret = execute_query(MYSQL(ictx), "COMMIT");
+	if (ret != MYSQL_SUCCESS) {
+		retval = MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+end:
+	if (retval != MAPISTORE_SUCCESS) {
+		execute_query(MYSQL(ictx), "ROLLBACK");
+	}
+	talloc_free(mem_ctx);
+	return retval;
+}
+
+
+/**
+  \details Get mapistore URIs for a set of FMIDs.
+
+  \param ictx valid pointer to indexing context
+  \param username samAccountName for current user
+  \param mem_ctx TALLOC_CTX to allocate mapistore URIs
+  \param count number of FMIDs to search for
+  \param fmids array of FMIDs to search for
+  \param uris array of count elements filled with the URIs found, NULL
+  for FMIDs which are not indexed
+  \param soft_deleted array of count elements filled with the Soft
+  Deleted state of each record
+
+  \return MAPISTORE_SUCCESS on success
+	  MAPISTORE_ERR_NOT_INITIALIZED if ictx pointer is invalid (NULL)
+	  MAPISTORE_ERR_INVALID_PARAMETER in case other parameters are not valid
+	  MAPISTORE_ERR_DATABASE_OPS in case of MySQL error
+ */
+static enum mapistore_error mysql_record_get_uris(struct indexing_context *ictx,
+						  const char *username,
+						  TALLOC_CTX *mem_ctx,
+						  uint32_t count,
+						  const uint64_t *fmids,
+						  char **uris,
+						  bool *soft_deleted)
+{
+	enum MYSQLRESULT	ret;
+	TALLOC_CTX		*local_mem_ctx;
+	MYSQL_RES		*res;
+	MYSQL_ROW		row;
+	const char		*_username;
+	char			*sql;
+	char			*list;
+	uint64_t		fmid;
+	uint64_t		*missing;
+	uint32_t		*missing_idx;
+	uint32_t		missing_count = 0;
+	uint32_t		offset, len, i, j, num_rows;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !uris, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !soft_deleted, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	for (i = 0; i < count; i++) {
+		uris[i] = NULL;
+		soft_deleted[i] = false;
+	}
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	/* Records found in the cache are not soft deleted */
+	if (ictx->cache) {
+		_memcached_get_uris(ictx, username, mem_ctx, count, fmids, uris);
+	}
+
+	local_mem_ctx = talloc_named(NULL, 0, "mysql_record_get_uris");
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	_username = _sql(local_mem_ctx, username);
+	MAPISTORE_RETVAL_IF(!_username, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+
+	/* Only query the database for the cache misses */
+	missing = talloc_array(local_mem_ctx, uint64_t, count);
+	missing_idx = talloc_array(local_mem_ctx, uint32_t, count);
+	MAPISTORE_RETVAL_IF(!missing || !missing_idx, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+	for (i = 0; i < count; i++) {
+		if (uris[i]) continue;
+		missing[missing_count] = fmids[i];
+		missing_idx[missing_count] = i;
+		missing_count++;
+	}
+
+	for (offset = 0; offset < missing_count; offset += len) {
+		len = missing_count - offset;
+		if (len > INDEXING_MYSQL_BATCH_SIZE) len = INDEXING_MYSQL_BATCH_SIZE;
+
+		list = _sql_fmid_list(local_mem_ctx, len, missing + offset);
+		MAPISTORE_RETVAL_IF(!list, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+		sql = talloc_asprintf(local_mem_ctx,
+			"SELECT fmid, url, soft_deleted FROM %s "
+			"WHERE username = '%s' AND fmid IN (%s)",
+			INDEXING_TABLE, _username, list);
+		MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+
+		ret = select_without_fetch(MYSQL(ictx), sql, &res);
+		if (ret == MYSQL_NOT_FOUND) continue;
+		MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, local_mem_ctx);
+
+		num_rows = mysql_num_rows(res);
+		for (i = 0; i < num_rows; i++) {
+			row = mysql_fetch_row(res);
+			fmid = strtoull(row[0], NULL, 0);
+			for (j = offset; j < offset + len; j++) {
+				if (missing[j] == fmid && !uris[missing_idx[j]]) {
+					uris[missing_idx[j]] = talloc_strdup(mem_ctx, row[1]);
+					soft_deleted[missing_idx[j]] = strtoull(row[2], NULL, 0) == 1;
+				}
+			}
+		}
+		mysql_free_result(res);
+	}
+
+	talloc_free(local_mem_ctx);
+	return MAPISTORE_SUCCESS;
+}
+
+
 static enum mapistore_error mysql_record_allocate_fmids(struct indexing_context *ictx,
 						      const char *username,
 						      int count,
@@ -776,14 +1510,47 @@ static enum mapistore_error mysql_record_allocate_fmid(struct indexing_context *
 	return mysql_record_allocate_fmids(ictx, username, 1, fmidp);
 }
 
+static enum mapistore_error mysql_record_release_fmids(struct indexing_context *ictx,
+						       const char *username,
+						       uint64_t fmid,
+						       int count)
+{
+	int		ret;
+	char		*sql;
+	TALLOC_CTX	*mem_ctx;
+
+	/* SANITY checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(count <= 0, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* Only the last allocated range can be given back */
+	sql = talloc_asprintf(mem_ctx,
+		"UPDATE %s SET next_fmid = %"PRIu64
+		" WHERE username='%s' AND next_fmid = %"PRIu64,
+		INDEXING_ALLOC_TABLE, fmid,
+		_sql(mem_ctx, username), fmid + count);
+	MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	ret = execute_query(MYSQL(ictx), sql);
+	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
 
 static int mapistore_indexing_mysql_destructor(struct indexing_context *ictx)
 {
 	if (ictx && ictx->data) {
 		MYSQL *conn = ictx->data;
-		if (ictx->cache) {
-			memcached_free((memcached_st *)ictx->cache);
-		}
+		/* The fmid lease gives its tail back through the connection */
+		TALLOC_FREE(ictx->lease);
+		TALLOC_FREE(ictx->cache);
 		if (ictx->url) {
 			OC_DEBUG(5, "Destroying indexing context `%s`\n", ictx->url);
 		} else {
@@ -855,12 +1622,16 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_mysql_init(struct mapistore_con
 	ictx->update_fmid = mysql_record_update;
 	ictx->get_uri = mysql_record_get_uri;
 	ictx->get_fmid = mysql_record_get_fmid;
+	ictx->add_fmids = mysql_record_add_fmids;
+	ictx->del_fmids = mysql_record_del_fmids;
+	ictx->get_uris = mysql_record_get_uris;
 	ictx->allocate_fmid = mysql_record_allocate_fmid;
 	ictx->allocate_fmids = mysql_record_allocate_fmids;
+	ictx->release_fmids = mysql_record_release_fmids;
 
 	/* Data pointers */
 	cache_url = mapistore_get_default_cache_url();
-	ictx->cache = _memcached_setup(ictx, cache_url, username);
+	_memcached_setup(ictx, cache_url);
 
 	*ictxp = ictx;
 
@@ -34,6 +34,282 @@
 
 #define	TDB_WRAP(context)	((struct tdb_wrap*)context->data)
 
+/* Secondary indexes stored alongside the FMID records:
+ *
+ * URI:<uri>      -> "0x%.16"PRIx64 FMID owning this URI
+ * URIDIR:<dir>   -> FMIDs (uint64_t array) of URIs directly under <dir>
+ * URISUB:<dir>   -> NUL separated list of sub directories of <dir>
+ * URIBASE:<name> -> FMIDs (uint64_t array) of URIs whose last path
+ *                   component is <name>
+ *
+ * URIs are indexed without their trailing slash, <dir> is the URI
+ * prefix up to and including its last slash and <name> what follows
+ * it. */
+#define	INDEXING_TDB_URI_TAG		"URI:"
+#define	INDEXING_TDB_DIR_TAG		"URIDIR:"
+#define	INDEXING_TDB_SUBDIR_TAG		"URISUB:"
+#define	INDEXING_TDB_BASE_TAG		"URIBASE:"
+#define	INDEXING_TDB_VERSION_KEY	"URIIndexVersion"
+#define	INDEXING_TDB_VERSION		"1"
+
+static TDB_DATA tdb_index_key(TALLOC_CTX *mem_ctx, const char *tag, const char *value, size_t len)
+{
+	TDB_DATA	key;
+
+	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "%s%.*s", tag, (int)len, value);
+	key.dsize = strlen((const char *) key.dptr);
+
+	return key;
+}
+
+static bool tdb_is_fmid_key(TDB_DATA key)
+{
+	size_t	tag_len = strlen(MAPISTORE_SOFT_DELETED_TAG);
+
+	if (key.dsize > 2 && key.dptr[0] == '0' && key.dptr[1] == 'x') {
+		return true;
+	}
+	if (key.dsize > tag_len && !strncmp((const char *)key.dptr, MAPISTORE_SOFT_DELETED_TAG, tag_len)) {
+		return true;
+	}
+
+	return false;
+}
+
+/* Length of the URI once its trailing slash is dropped */
+static size_t tdb_uri_len(const char *uri, size_t len)
+{
+	if (len && uri[len - 1] == '/') {
+		len--;
+	}
+	return len;
+}
+
+/* Length of the directory part of a URI, including the last slash */
+static size_t tdb_uri_dir_len(const char *uri, size_t len)
+{
+	while (len && uri[len - 1] != '/') {
+		len--;
+	}
+	return len;
+}
+
+static void tdb_index_list_add(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+			       const char *tag, const char *value, size_t len,
+			       uint64_t fmid)
+{
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+
+	key = tdb_index_key(mem_ctx, tag, value, len);
+	dbuf.dptr = (unsigned char *) &fmid;
+	dbuf.dsize = sizeof (uint64_t);
+
+	if (tdb_append(tdb, key, dbuf) == -1) {
+		OC_DEBUG(3, "Unable to index 0x%.16"PRIx64" under %s", fmid, key.dptr);
+	}
+	talloc_free(key.dptr);
+}
+
+static void tdb_index_list_del(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+			       const char *tag, const char *value, size_t len,
+			       uint64_t fmid)
+{
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	uint64_t	*fmids;
+	size_t		count, i;
+
+	key = tdb_index_key(mem_ctx, tag, value, len);
+
+	/* Other processes append to the same list meanwhile */
+	if (tdb_chainlock(tdb, key) == -1) {
+		OC_DEBUG(3, "Unable to lock %s: %s", key.dptr, tdb_errorstr(tdb));
+		talloc_free(key.dptr);
+		return;
+	}
+
+	dbuf = tdb_fetch(tdb, key);
+	if (!dbuf.dptr) {
+		tdb_chainunlock(tdb, key);
+		talloc_free(key.dptr);
+		return;
+	}
+
+	fmids = (uint64_t *) dbuf.dptr;
+	count = dbuf.dsize / sizeof (uint64_t);
+	for (i = 0; i < count; i++) {
+		if (fmids[i] == fmid) {
+			fmids[i] = fmids[count - 1];
+			count--;
+			break;
+		}
+	}
+
+	/* Empty lists are kept so directories remain known */
+	dbuf.dsize = count * sizeof (uint64_t);
+	if (tdb_store(tdb, key, dbuf, TDB_REPLACE) == -1) {
+		OC_DEBUG(3, "Unable to unindex 0x%.16"PRIx64" from %s", fmid, key.dptr);
+	}
+	tdb_chainunlock(tdb, key);
+	free(dbuf.dptr);
+	talloc_free(key.dptr);
+}
+
+static bool tdb_index_dir_known(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+				const char *dir, size_t dir_len)
+{
+	TDB_DATA	key;
+	int		known;
+
+	key = tdb_index_key(mem_ctx, INDEXING_TDB_DIR_TAG, dir, dir_len);
+	known = tdb_exists(tdb, key);
+	talloc_free(key.dptr);
+	if (known) return true;
+
+	key = tdb_index_key(mem_ctx, INDEXING_TDB_SUBDIR_TAG, dir, dir_len);
+	known = tdb_exists(tdb, key);
+	talloc_free(key.dptr);
+
+	return known ? true : false;
+}
+
+/* Register a directory as a child of its parent, up the tree until
+ * an already known directory is found */
+static void tdb_index_dir_register(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+				   const char *dir, size_t dir_len)
+{
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	size_t		parent_len;
+	bool		parent_known;
+
+	if (tdb_index_dir_known(tdb, mem_ctx, dir, dir_len)) return;
+
+	while (dir_len > 1) {
+		parent_len = tdb_uri_dir_len(dir, dir_len - 1);
+		if (!parent_len) return;
+
+		parent_known = tdb_index_dir_known(tdb, mem_ctx, dir, parent_len);
+
+		key = tdb_index_key(mem_ctx, INDEXING_TDB_SUBDIR_TAG, dir, parent_len);
+		dbuf.dptr = (unsigned char *) talloc_strndup(mem_ctx, dir, dir_len);
+		dbuf.dsize = dir_len + 1;
+		if (tdb_append(tdb, key, dbuf) == -1) {
+			OC_DEBUG(3, "Unable to index directory %s", dbuf.dptr);
+		}
+		talloc_free(dbuf.dptr);
+		talloc_free(key.dptr);
+
+		if (parent_known) return;
+		dir_len = parent_len;
+	}
+}
+
+static void tdb_index_add(struct tdb_context *tdb, uint64_t fmid, const char *uri, size_t uri_len)
+{
+	TALLOC_CTX	*mem_ctx;
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	size_t		len, dir_len;
+
+	mem_ctx = talloc_named(NULL, 0, "tdb_index_add");
+
+	len = tdb_uri_len(uri, uri_len);
+	key = tdb_index_key(mem_ctx, INDEXING_TDB_URI_TAG, uri, len);
+	dbuf.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%.16"PRIx64, fmid);
+	dbuf.dsize = strlen((const char *) dbuf.dptr);
+	if (tdb_store(tdb, key, dbuf, TDB_REPLACE) == -1) {
+		OC_DEBUG(3, "Unable to index URI of 0x%.16"PRIx64, fmid);
+	}
+
+	dir_len = tdb_uri_dir_len(uri, len);
+	if (dir_len) {
+		tdb_index_dir_register(tdb, mem_ctx, uri, dir_len);
+		tdb_index_list_add(tdb, mem_ctx, INDEXING_TDB_DIR_TAG, uri, dir_len, fmid);
+		tdb_index_list_add(tdb, mem_ctx, INDEXING_TDB_BASE_TAG, uri + dir_len, len - dir_len, fmid);
+	}
+
+	talloc_free(mem_ctx);
+}
+
+static void tdb_index_del(struct tdb_context *tdb, uint64_t fmid, const char *uri, size_t uri_len)
+{
+	TALLOC_CTX	*mem_ctx;
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	size_t		len, dir_len;
+
+	mem_ctx = talloc_named(NULL, 0, "tdb_index_del");
+
+	len = tdb_uri_len(uri, uri_len);
+	key = tdb_index_key(mem_ctx, INDEXING_TDB_URI_TAG, uri, len);
+	/* Only drop the URI entry if it still belongs to this fmid */
+	dbuf = tdb_fetch(tdb, key);
+	if (dbuf.dptr) {
+		if (strtoull(talloc_strndup(mem_ctx, (char *)dbuf.dptr, dbuf.dsize), NULL, 16) == fmid) {
+			tdb_delete(tdb, key);
+		}
+		free(dbuf.dptr);
+	}
+
+	dir_len = tdb_uri_dir_len(uri, len);
+	if (dir_len) {
+		tdb_index_list_del(tdb, mem_ctx, INDEXING_TDB_DIR_TAG, uri, dir_len, fmid);
+		tdb_index_list_del(tdb, mem_ctx, INDEXING_TDB_BASE_TAG, uri + dir_len, len - dir_len, fmid);
+	}
+
+	talloc_free(mem_ctx);
+}
+
+static int tdb_index_build_traverse(struct tdb_context *tdb_ctx, TDB_DATA key, TDB_DATA value, void *data)
+{
+	TALLOC_CTX	*mem_ctx;
+	const char	*key_str;
+	uint64_t	fmid;
+
+	if (!tdb_is_fmid_key(key) || !value.dptr) return 0;
+
+	mem_ctx = talloc_named(NULL, 0, "tdb_index_build_traverse");
+	key_str = talloc_strndup(mem_ctx, (const char *) key.dptr, key.dsize);
+	if (key_str[0] != '0') {
+		key_str += strlen(MAPISTORE_SOFT_DELETED_TAG);
+	}
+	fmid = strtoull(key_str, NULL, 16);
+	if (fmid) {
+		tdb_index_add(tdb_ctx, fmid, (const char *) value.dptr, value.dsize);
+	}
+	talloc_free(mem_ctx);
+
+	return 0;
+}
+
+/**
+   \details Build the URI indexes of databases created before they
+   were introduced. This is a one-off full traversal.
+
+   \param tdb pointer to the indexing TDB database
+ */
+static void tdb_index_upgrade(struct tdb_context *tdb)
+{
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	int		ret;
+
+	key.dptr = (unsigned char *) INDEXING_TDB_VERSION_KEY;
+	key.dsize = strlen(INDEXING_TDB_VERSION_KEY);
+
+	ret = tdb_exists(tdb, key);
+	if (ret) return;
+
+	OC_DEBUG(3, "Building URI indexes on indexing database");
+	tdb_traverse(tdb, tdb_index_build_traverse, NULL);
+
+	dbuf.dptr = (unsigned char *) INDEXING_TDB_VERSION;
+	dbuf.dsize = strlen(INDEXING_TDB_VERSION);
+	tdb_store(tdb, key, dbuf, TDB_REPLACE);
+}
+
 
 
 static enum mapistore_error tdb_search_existing_fmid(struct indexing_context *ictx,
@@ -110,6 +386,8 @@ static enum mapistore_error tdb_record_add(struct indexing_context *ictx,
 		return MAPISTORE_ERR_DATABASE_OPS;
 	}
 
+	tdb_index_add(TDB_WRAP(ictx)->tdb, fmid, mapistore_URI, strlen(mapistore_URI));
+
 	return MAPISTORE_SUCCESS;
 }
 
@@ -121,6 +399,7 @@ static enum mapistore_error tdb_record_update(struct indexing_context *ictx,
 	int		ret;
 	TDB_DATA	key;
 	TDB_DATA	dbuf;
+	TDB_DATA	old_dbuf;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -132,6 +411,9 @@ static enum mapistore_error tdb_record_update(struct indexing_context *ictx,
 	key.dptr = (unsigned char *) talloc_asprintf(ictx, "0x%.16"PRIx64, fmid);
 	key.dsize = strlen((const char *) key.dptr);
 
+	/* Retrieve the previous URI to update the indexes */
+	old_dbuf = tdb_fetch(TDB_WRAP(ictx)->tdb, key);
+
 	dbuf.dptr = (unsigned char *) talloc_strdup(ictx, mapistore_URI);
 	dbuf.dsize = strlen((const char *) dbuf.dptr);
 
@@ -142,9 +424,16 @@ static enum mapistore_error tdb_record_update(struct indexing_context *ictx,
 	if (ret == -1) {
 		OC_DEBUG(3, "Unable to update 0x%.16"PRIx64" record: %s\n",
 			  fmid, mapistore_URI);
+		free(old_dbuf.dptr);
 		return MAPISTORE_ERR_NOT_FOUND;
 	}
 
+	if (old_dbuf.dptr) {
+		tdb_index_del(TDB_WRAP(ictx)->tdb, fmid, (const char *) old_dbuf.dptr, old_dbuf.dsize);
+		free(old_dbuf.dptr);
+	}
+	tdb_index_add(TDB_WRAP(ictx)->tdb, fmid, mapistore_URI, strlen(mapistore_URI));
+
 	return MAPISTORE_SUCCESS;
 }
 
@@ -195,9 +484,17 @@ static enum mapistore_error tdb_record_del(struct indexing_context *ictx,
 		talloc_free(newkey.dptr);
 		break;
 	case MAPISTORE_PERMANENT_DELETE:
+		dbuf = tdb_fetch(TDB_WRAP(ictx)->tdb, key);
 		ret = tdb_delete(TDB_WRAP(ictx)->tdb, key);
 		talloc_free(key.dptr);
-		MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERR_DATABASE_OPS, NULL);
+		if (ret) {
+			free(dbuf.dptr);
+			return MAPISTORE_ERR_DATABASE_OPS;
+		}
+		if (dbuf.dptr) {
+			tdb_index_del(TDB_WRAP(ictx)->tdb, fmid, (const char *) dbuf.dptr, dbuf.dsize);
+			free(dbuf.dptr);
+		}
 		break;
 	default:
 		return MAPISTORE_ERR_INVALID_PARAMETER;
@@ -256,80 +553,181 @@ static enum mapistore_error tdb_record_get_uri(struct indexing_context *ictx,
 }
 
 /**
-   \details A slow but effective way to retrieve an fmid from a uri
+   \details Retrieve the fmid associated to a FMID record key and
+   whether it is soft deleted
 
-   \param mstore_ctx pointer to the mapistore context
-   \param mem_ctx pointer to the talloc context
-   \param fmid the fmid/key to the record
-   \param urip pointer to the uri pointer
-   \param soft_deletedp pointer to the soft deleted pointer
+   \return true if key is a FMID record key, otherwise false
+ */
+static bool tdb_fmid_from_key(TDB_DATA key, uint64_t *fmidp, bool *soft_deletedp)
+{
+	char	key_str[64];
+	size_t	tag_len = strlen(MAPISTORE_SOFT_DELETED_TAG);
+	size_t	offset = 0;
 
-   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+	if (!tdb_is_fmid_key(key) || key.dsize >= sizeof (key_str)) return false;
+
+	memcpy(key_str, key.dptr, key.dsize);
+	key_str[key.dsize] = '\0';
+
+	*soft_deletedp = false;
+	if (key_str[0] != '0') {
+		offset = tag_len;
+		*soft_deletedp = true;
+	}
+	*fmidp = strtoull(key_str + offset, NULL, 16);
+
+	return true;
+}
+
+/**
+   \details Fetch the URI of a fmid, whether live or soft deleted
+
+   \param tdb pointer to the indexing database
+   \param mem_ctx pointer to the memory context
+   \param fmid the fmid to lookup
+   \param soft_deletedp pointer to the soft deleted boolean to set
+
+   \return allocated URI without trailing slash on success, otherwise NULL
  */
+static char *tdb_fetch_uri(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+			   uint64_t fmid, bool *soft_deletedp)
+{
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	char		*uri;
+
+	*soft_deletedp = false;
+	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%.16"PRIx64, fmid);
+	key.dsize = strlen((const char *) key.dptr);
+	dbuf = tdb_fetch(tdb, key);
+	talloc_free(key.dptr);
+
+	if (!dbuf.dptr) {
+		key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "%s0x%.16"PRIx64,
+							     MAPISTORE_SOFT_DELETED_TAG, fmid);
+		key.dsize = strlen((const char *) key.dptr);
+		dbuf = tdb_fetch(tdb, key);
+		talloc_free(key.dptr);
+		if (!dbuf.dptr) return NULL;
+		*soft_deletedp = true;
+	}
+
+	uri = talloc_strndup(mem_ctx, (const char *) dbuf.dptr, tdb_uri_len((const char *) dbuf.dptr, dbuf.dsize));
+	free(dbuf.dptr);
+
+	return uri;
+}
+
 struct tdb_get_fid_data {
 	bool		found;
 	uint64_t	fmid;
-	char		*uri;
-	size_t		uri_len;
-	uint32_t	wildcard_count;
-	char		*startswith;
-	char		*endswith;
+	bool		soft_deleted;
+	const char	*startswith;
+	const char	*endswith;
 };
 
-static int tdb_get_fid_traverse(struct tdb_context *tdb_ctx, TDB_DATA key, TDB_DATA value, void *data)
+static bool tdb_uri_match(const char *uri, const struct tdb_get_fid_data *tdb_data)
 {
-	struct tdb_get_fid_data	*tdb_data;
-	char			*key_str, *cmp_uri, *slash_ptr;
-	TALLOC_CTX		*mem_ctx;
-	int			ret = 0;
+	size_t	uri_len = strlen(uri);
+	size_t	start_len = strlen(tdb_data->startswith);
+	size_t	end_len = strlen(tdb_data->endswith);
 
-	mem_ctx = talloc_zero(NULL, void);
-	tdb_data = data;
-	cmp_uri = talloc_array(mem_ctx, char, value.dsize + 1);
-	memcpy(cmp_uri, value.dptr, value.dsize);
-	*(cmp_uri + value.dsize) = 0;
-	slash_ptr = cmp_uri + value.dsize - 1;
-	if (*slash_ptr == '/') {
-		*slash_ptr = 0;
-	}
-	if (strcmp(cmp_uri, tdb_data->uri) == 0) {
-		key_str = talloc_strndup(mem_ctx, (char *) key.dptr, key.dsize);
-		tdb_data->fmid = strtoull(key_str, NULL, 16);
-		tdb_data->found = true;
-		ret = 1;
+	if (uri_len < start_len + end_len) return false;
+	if (strncmp(uri, tdb_data->startswith, start_len)) return false;
+	if (strcmp(uri + uri_len - end_len, tdb_data->endswith)) return false;
+
+	return true;
+}
+
+/**
+   \details Search a list of fmids for the first URI matching the
+   wildcard expression
+
+   \return true if a matching record was found, otherwise false
+ */
+static bool tdb_index_list_match(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+				 TDB_DATA key, struct tdb_get_fid_data *tdb_data)
+{
+	TDB_DATA	dbuf;
+	uint64_t	*fmids;
+	size_t		count, i;
+	char		*uri;
+	bool		soft_deleted;
+
+	dbuf = tdb_fetch(tdb, key);
+	if (!dbuf.dptr) return false;
+
+	fmids = (uint64_t *) dbuf.dptr;
+	count = dbuf.dsize / sizeof (uint64_t);
+	for (i = 0; i < count && !tdb_data->found; i++) {
+		uri = tdb_fetch_uri(tdb, mem_ctx, fmids[i], &soft_deleted);
+		if (uri && tdb_uri_match(uri, tdb_data)) {
+			tdb_data->found = true;
+			tdb_data->fmid = fmids[i];
+			tdb_data->soft_deleted = soft_deleted;
+		}
+		talloc_free(uri);
 	}
-	
-	talloc_free(mem_ctx);
+	free(dbuf.dptr);
 
-	return ret;
+	return tdb_data->found;
+}
+
+/**
+   \details Walk the directory tree below the directory part of the
+   startswith expression, looking for a matching URI
+ */
+static void tdb_index_dir_match(struct tdb_context *tdb, TALLOC_CTX *mem_ctx,
+				const char *dir, size_t dir_len,
+				struct tdb_get_fid_data *tdb_data)
+{
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	const char	*subdir;
+	size_t		offset, len, cmp_len;
+
+	key = tdb_index_key(mem_ctx, INDEXING_TDB_DIR_TAG, dir, dir_len);
+	tdb_index_list_match(tdb, mem_ctx, key, tdb_data);
+	talloc_free(key.dptr);
+	if (tdb_data->found) return;
+
+	key = tdb_index_key(mem_ctx, INDEXING_TDB_SUBDIR_TAG, dir, dir_len);
+	dbuf = tdb_fetch(tdb, key);
+	talloc_free(key.dptr);
+	if (!dbuf.dptr) return;
+
+	for (offset = 0; offset < dbuf.dsize && !tdb_data->found; offset += len + 1) {
+		subdir = (const char *) dbuf.dptr + offset;
+		len = strnlen(subdir, dbuf.dsize - offset);
+		/* Only descend into sub directories compatible with
+		 * the startswith expression */
+		cmp_len = strlen(tdb_data->startswith);
+		if (cmp_len > len) cmp_len = len;
+		if (strncmp(subdir, tdb_data->startswith, cmp_len)) continue;
+		tdb_index_dir_match(tdb, mem_ctx, subdir, len, tdb_data);
+	}
+	free(dbuf.dptr);
 }
 
 static int tdb_get_fid_traverse_partial(struct tdb_context *tdb_ctx, TDB_DATA key, TDB_DATA value, void *data)
 {
-	struct tdb_get_fid_data	*tdb_data;
-	char			*key_str, *cmp_uri, *slash_ptr;
+	struct tdb_get_fid_data	*tdb_data = data;
+	char			*cmp_uri;
 	TALLOC_CTX		*mem_ctx;
+	uint64_t		fmid;
+	bool			soft_deleted;
 	int			ret = 0;
 
+	if (!tdb_fmid_from_key(key, &fmid, &soft_deleted)) return 0;
+
 	mem_ctx = talloc_zero(NULL, void);
-	tdb_data = data;
-	cmp_uri = talloc_array(mem_ctx, char, value.dsize + 1);
-	memcpy(cmp_uri, value.dptr, value.dsize);
-	*(cmp_uri + value.dsize) = 0;
-	slash_ptr = cmp_uri + value.dsize - 1;
-	if (*slash_ptr == '/') {
-		*slash_ptr = 0;
-	}
-
-	if (!strncmp(cmp_uri, tdb_data->startswith, strlen(tdb_data->startswith)) &&
-	    !strncmp(cmp_uri + (strlen(cmp_uri) - strlen(tdb_data->endswith)), tdb_data->endswith, 
-		     strlen(tdb_data->endswith))) {
-		    key_str = talloc_strndup(mem_ctx, (char *) key.dptr, key.dsize);
-		    tdb_data->fmid = strtoull(key_str, NULL, 16);
-		    tdb_data->found = true;
-		    ret = 1;
-	}
-	
+	cmp_uri = talloc_strndup(mem_ctx, (const char *) value.dptr, tdb_uri_len((const char *) value.dptr, value.dsize));
+	if (tdb_uri_match(cmp_uri, tdb_data)) {
+		tdb_data->fmid = fmid;
+		tdb_data->soft_deleted = soft_deleted;
+		tdb_data->found = true;
+		ret = 1;
+	}
 	talloc_free(mem_ctx);
 
 	return ret;
@@ -340,10 +738,14 @@ static enum mapistore_error tdb_record_get_fmid(struct indexing_context *ictx,
 					        const char *uri, bool partial,
 					        uint64_t *fmidp, bool *soft_deletedp)
 {
-	int				ret;
+	TALLOC_CTX			*mem_ctx;
+	struct tdb_context		*tdb;
 	struct tdb_get_fid_data		tdb_data;
-	char				*slash_ptr;
-	uint32_t			i;
+	TDB_DATA			key;
+	TDB_DATA			dbuf;
+	const char			*wildcard;
+	char				*fmid_str;
+	size_t				uri_len, start_len, end_len, dir_len;
 
 	/* SANITY checks */
 	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -352,60 +754,201 @@ static enum mapistore_error tdb_record_get_fmid(struct indexing_context *ictx,
 	MAPISTORE_RETVAL_IF(!fmidp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!soft_deletedp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
-	/* Check if the fmid exists within the database */
-	tdb_data.found = false;
-	tdb_data.uri = talloc_strdup(NULL, uri);
-	tdb_data.uri_len = strlen(uri);
-
-	tdb_data.startswith = NULL;
-	tdb_data.endswith = NULL;
-	tdb_data.wildcard_count = 0;
+	tdb = TDB_WRAP(ictx)->tdb;
+	mem_ctx = talloc_named(NULL, 0, "tdb_record_get_fmid");
 
-	slash_ptr = tdb_data.uri + tdb_data.uri_len - 1;
-	if (*slash_ptr == '/') {
-		*slash_ptr = 0;
-		tdb_data.uri_len--;
-	}
-	if (partial == false) {
-		tdb_traverse_read(TDB_WRAP(ictx)->tdb, tdb_get_fid_traverse, &tdb_data);
-	} else {
-		for (tdb_data.wildcard_count = 0, i = 0; i < strlen(uri); i++) {
-			if (uri[i] == '*') tdb_data.wildcard_count += 1;
+	tdb_data.found = false;
+	tdb_data.fmid = 0;
+	tdb_data.soft_deleted = false;
+
+	wildcard = (partial == true) ? strchr(uri, '*') : NULL;
+	if (wildcard == NULL) {
+		/* Exact match: single fetch on the URI index */
+		key = tdb_index_key(mem_ctx, INDEXING_TDB_URI_TAG, uri, tdb_uri_len(uri, strlen(uri)));
+		dbuf = tdb_fetch(tdb, key);
+		if (dbuf.dptr) {
+			fmid_str = talloc_strndup(mem_ctx, (const char *) dbuf.dptr, dbuf.dsize);
+			free(dbuf.dptr);
+			tdb_data.fmid = strtoull(fmid_str, NULL, 16);
+			if (tdb_fetch_uri(tdb, mem_ctx, tdb_data.fmid, &tdb_data.soft_deleted)) {
+				tdb_data.found = true;
+			}
 		}
-
-		switch (tdb_data.wildcard_count) {
-		case 0: /* complete URI */
-			partial = true;
-			break;
-		case 1: /* start and end only */
-			tdb_data.endswith = strchr(uri, '*') + 1;
-			tdb_data.startswith = talloc_strndup(NULL, uri, strlen(uri) - strlen(tdb_data.endswith) - 1);
-			break;
-		default:
+	} else {
+		if (strchr(wildcard + 1, '*')) {
 			OC_DEBUG(0, "Too many wildcards found (1 maximum)\n");
-			talloc_free(tdb_data.uri);
+			talloc_free(mem_ctx);
 			return MAPISTORE_ERR_NOT_FOUND;
 		}
 
-		if (partial == true) {
-			tdb_traverse_read(TDB_WRAP(ictx)->tdb, tdb_get_fid_traverse_partial, &tdb_data);
-			talloc_free(tdb_data.startswith);
+		start_len = wildcard - uri;
+		tdb_data.startswith = talloc_strndup(mem_ctx, uri, start_len);
+		/* Matched against URIs without their trailing slash */
+		uri_len = tdb_uri_len(uri, strlen(uri));
+		end_len = (uri_len > start_len + 1) ? uri_len - start_len - 1 : 0;
+		tdb_data.endswith = talloc_strndup(mem_ctx, wildcard + 1, end_len);
+
+		dir_len = tdb_uri_dir_len(tdb_data.startswith, start_len);
+		if (dir_len) {
+			/* Look below the directory part of the prefix */
+			tdb_index_dir_match(tdb, mem_ctx, tdb_data.startswith, dir_len, &tdb_data);
+		} else if ((dir_len = tdb_uri_dir_len(tdb_data.endswith, end_len)) != 0) {
+			/* No directory in the prefix but the suffix
+			 * holds a complete last path component */
+			key = tdb_index_key(mem_ctx, INDEXING_TDB_BASE_TAG,
+					    tdb_data.endswith + dir_len, end_len - dir_len);
+			tdb_index_list_match(tdb, mem_ctx, key, &tdb_data);
 		} else {
-			tdb_traverse_read(TDB_WRAP(ictx)->tdb, tdb_get_fid_traverse, &tdb_data);
+			/* Nothing to narrow the search on */
+			OC_DEBUG(5, "No index usable for %s, traversing indexing database", uri);
+			tdb_traverse_read(tdb, tdb_get_fid_traverse_partial, &tdb_data);
 		}
 	}
 
-	talloc_free(tdb_data.uri);
-	if (tdb_data.found) {
-		*fmidp = tdb_data.fmid;
-		*soft_deletedp = false; /* TODO: implement the feature */
-		ret = MAPISTORE_SUCCESS;
+	talloc_free(mem_ctx);
+	MAPISTORE_RETVAL_IF(!tdb_data.found, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	*fmidp = tdb_data.fmid;
+	*soft_deletedp = tdb_data.soft_deleted;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Add a set of FMID records within a single transaction:
+   either all of them are recorded or none is.
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error tdb_record_add_fmids(struct indexing_context *ictx,
+						 const char *username,
+						 uint32_t count,
+						 const uint64_t *fmids,
+						 const char **uris)
+{
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !uris, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	if (tdb_transaction_start(TDB_WRAP(ictx)->tdb) == -1) {
+		OC_DEBUG(3, "Unable to start transaction: %s\n",
+			 tdb_errorstr(TDB_WRAP(ictx)->tdb));
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	for (i = 0; i < count && retval == MAPISTORE_SUCCESS; i++) {
+		retval = tdb_record_add(ictx, username, fmids[i], uris[i]);
 	}
-	else {
-		ret = MAPISTORE_ERR_NOT_FOUND;
+
+	if (retval != MAPISTORE_SUCCESS) {
+		tdb_transaction_cancel(TDB_WRAP(ictx)->tdb);
+		return retval;
 	}
 
-	return ret;
+	if (tdb_transaction_commit(TDB_WRAP(ictx)->tdb) == -1) {
+		OC_DEBUG(3, "Unable to commit %"PRIu32" records: %s\n", count,
+			 tdb_errorstr(TDB_WRAP(ictx)->tdb));
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Delete a set of FMID records within a single transaction.
+   Unknown and invalid FMIDs are skipped so they do not prevent the
+   deletion of the other records; a database error still cancels the
+   whole batch.
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error tdb_record_del_fmids(struct indexing_context *ictx,
+						 const char *username,
+						 uint32_t count,
+						 const uint64_t *fmids,
+						 uint8_t flags)
+{
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(flags != MAPISTORE_SOFT_DELETE &&
+			    flags != MAPISTORE_PERMANENT_DELETE,
+			    MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	if (tdb_transaction_start(TDB_WRAP(ictx)->tdb) == -1) {
+		OC_DEBUG(3, "Unable to start transaction: %s\n",
+			 tdb_errorstr(TDB_WRAP(ictx)->tdb));
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	for (i = 0; i < count && retval == MAPISTORE_SUCCESS; i++) {
+		retval = tdb_record_del(ictx, username, fmids[i], flags);
+		if (retval == MAPISTORE_ERR_INVALID_PARAMETER || retval == MAPISTORE_ERR_NOT_FOUND) {
+			OC_DEBUG(3, "Skipping deletion of record 0x%.16"PRIx64": %s\n",
+				 fmids[i], mapistore_errstr(retval));
+			retval = MAPISTORE_SUCCESS;
+		}
+	}
+
+	if (retval != MAPISTORE_SUCCESS) {
+		tdb_transaction_cancel(TDB_WRAP(ictx)->tdb);
+		return retval;
+	}
+
+	if (tdb_transaction_commit(TDB_WRAP(ictx)->tdb) == -1) {
+		OC_DEBUG(3, "Unable to commit deletion of %"PRIu32" records: %s\n", count,
+			 tdb_errorstr(TDB_WRAP(ictx)->tdb));
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Retrieve the URIs of a set of FMIDs. uris entries are set
+   to NULL for FMIDs which are not indexed.
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error tdb_record_get_uris(struct indexing_context *ictx,
+						const char *username,
+						TALLOC_CTX *mem_ctx,
+						uint32_t count,
+						const uint64_t *fmids,
+						char **uris,
+						bool *soft_deleted)
+{
+	enum mapistore_error	retval;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !uris, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !soft_deleted, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	for (i = 0; i < count; i++) {
+		soft_deleted[i] = false;
+		retval = tdb_record_get_uri(ictx, username, mem_ctx, fmids[i],
+					    &uris[i], &soft_deleted[i]);
+		if (retval == MAPISTORE_ERR_NOT_FOUND) continue;
+		MAPISTORE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	return MAPISTORE_SUCCESS;
 }
 
 
@@ -427,6 +970,10 @@ static enum mapistore_error tdb_record_allocate_fmids(struct indexing_context *i
 	key.dptr = (unsigned char*)"GlobalCount";
 	key.dsize = strlen((const char *)key.dptr);
 
+	/* Other processes allocate from the same counter */
+	ret = tdb_chainlock(TDB_WRAP(ictx)->tdb, key);
+	MAPISTORE_RETVAL_IF(ret == -1, MAPISTORE_ERR_DATABASE_OPS, NULL);
+
 	data = tdb_fetch(TDB_WRAP(ictx)->tdb, key);
 	if (!data.dptr || !data.dsize) {
 		GlobalCount = 1;
@@ -434,16 +981,18 @@ static enum mapistore_error tdb_record_allocate_fmids(struct indexing_context *i
 	else {
 		GlobalCount = strtoull((const char*)data.dptr, NULL, 16);
 	}
+	free(data.dptr);
 
 	/* Save and increment the counter (reserve) */
 	*fmidp = GlobalCount;
-	GlobalCount += count,
+	GlobalCount += count;
 
 	/* Store new counter */
 	data.dptr = (unsigned char *) talloc_asprintf(ictx, "0x%.16"PRIx64, GlobalCount);
-	data.dsize = strlen((const char *) data.dptr);
-	ret = tdb_store(TDB_WRAP(ictx)->tdb, key, data, TDB_REPLACE);
+	data.dsize = data.dptr ? strlen((const char *) data.dptr) : 0;
+	ret = data.dptr ? tdb_store(TDB_WRAP(ictx)->tdb, key, data, TDB_REPLACE) : -1;
 	talloc_free(data.dptr);
+	tdb_chainunlock(TDB_WRAP(ictx)->tdb, key);
 
 	if (ret == -1) {
 		OC_DEBUG(3, "Unable to create %s record: 0x%.16"PRIx64" \n",
@@ -461,6 +1010,85 @@ static enum mapistore_error tdb_record_allocate_fmid(struct indexing_context *ic
 	return tdb_record_allocate_fmids(ictx, username, 1, fmidp);
 }
 
+/**
+   \details Return the change counter of the indexing database. Every
+   process opening it enables the counter, so it moves on any store or
+   delete, whoever makes it.
+ */
+static uint64_t tdb_record_get_generation(struct indexing_context *ictx)
+{
+	return (uint64_t) tdb_get_seqnum(TDB_WRAP(ictx)->tdb);
+}
+
+/**
+   \details Give back the count fmids starting at fmid. The counter is
+   only rewound when it still points right after them, that is when
+   nobody allocated since the range was.
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_EXIST if other
+   fmids were allocated after the range, otherwise MAPISTORE error
+ */
+static enum mapistore_error tdb_record_release_fmids(struct indexing_context *ictx,
+						     const char *username,
+						     uint64_t fmid,
+						     int count)
+{
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	TDB_DATA		key, data;
+	int			ret;
+	uint64_t		GlobalCount;
+
+	/* SANITY checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(count <= 0, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	key.dptr = (unsigned char*)"GlobalCount";
+	key.dsize = strlen((const char *)key.dptr);
+
+	/* The check and the rewind must not let an allocation in between */
+	ret = tdb_chainlock(TDB_WRAP(ictx)->tdb, key);
+	MAPISTORE_RETVAL_IF(ret == -1, MAPISTORE_ERR_DATABASE_OPS, NULL);
+
+	data = tdb_fetch(TDB_WRAP(ictx)->tdb, key);
+	if (!data.dptr || !data.dsize) {
+		free(data.dptr);
+		retval = MAPISTORE_ERR_NOT_FOUND;
+		goto end;
+	}
+	GlobalCount = strtoull((const char*)data.dptr, NULL, 16);
+	free(data.dptr);
+
+	/* Only the last allocated range can be given back */
+	if (GlobalCount != fmid + (uint64_t) count) {
+		retval = MAPISTORE_ERR_EXIST;
+		goto end;
+	}
+
+	data.dptr = (unsigned char *) talloc_asprintf(ictx, "0x%.16"PRIx64, fmid);
+	if (!data.dptr) {
+		retval = MAPISTORE_ERR_NO_MEMORY;
+		goto end;
+	}
+	data.dsize = strlen((const char *) data.dptr);
+	ret = tdb_store(TDB_WRAP(ictx)->tdb, key, data, TDB_REPLACE);
+	talloc_free(data.dptr);
+	if (ret == -1) {
+		retval = MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+end:
+	tdb_chainunlock(TDB_WRAP(ictx)->tdb, key);
+	return retval;
+}
+
+static int mapistore_indexing_tdb_destructor(struct indexing_context *ictx)
+{
+	/* The fmid lease gives its tail back through the database */
+	TALLOC_FREE(ictx->lease);
+	return 0;
+}
+
 
 /**
    \details Open connection to indexing database for a given user
@@ -506,6 +1134,12 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_tdb_init(struct mapistore_conte
 		return MAPISTORE_ERR_DATABASE_INIT;
 	}
 
+	/* Build URI indexes for databases created before they existed */
+	tdb_index_upgrade(TDB_WRAP(ictx)->tdb);
+
+	/* Let indexing caches notice changes made by other processes */
+	tdb_enable_seqnum(TDB_WRAP(ictx)->tdb);
+
 	/* TODO: extract url from backend mapping, by the moment we use the username */
 	ictx->url = talloc_strdup(ictx, username);
 
@@ -515,8 +1149,14 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_tdb_init(struct mapistore_conte
 	ictx->update_fmid = tdb_record_update;
 	ictx->get_uri = tdb_record_get_uri;
 	ictx->get_fmid = tdb_record_get_fmid;
+	ictx->add_fmids = tdb_record_add_fmids;
+	ictx->del_fmids = tdb_record_del_fmids;
+	ictx->get_uris = tdb_record_get_uris;
 	ictx->allocate_fmid = tdb_record_allocate_fmid;
 	ictx->allocate_fmids = tdb_record_allocate_fmids;
+	ictx->release_fmids = tdb_record_release_fmids;
+	ictx->get_generation = tdb_record_get_generation;
+	talloc_set_destructor(ictx, mapistore_indexing_tdb_destructor);
 
 	*ictxp = ictx;
 
@@ -30,11 +30,14 @@
 #include <param.h>
 
 struct MAPINAMEID;
+struct namedprops_cache;
 
 struct namedprops_context {
 	enum mapistore_error (*get_mapped_id)(struct namedprops_context *, struct MAPINAMEID, uint16_t *);
 	enum mapistore_error (*next_unused_id)(struct namedprops_context *, uint16_t *);
 	enum mapistore_error (*create_id)(struct namedprops_context *, struct MAPINAMEID, uint16_t);
+	enum mapistore_error (*get_mapped_ids)(struct namedprops_context *, uint32_t, struct MAPINAMEID *, uint16_t *);
+	enum mapistore_error (*create_ids)(struct namedprops_context *, uint32_t, struct MAPINAMEID *, const uint16_t *);
 	enum mapistore_error (*get_nameid)(struct namedprops_context *, uint16_t, TALLOC_CTX *, struct MAPINAMEID **);
 	enum mapistore_error (*get_nameid_type)(struct namedprops_context *, uint16_t, uint16_t *);
 	enum mapistore_error (*transaction_start)(struct namedprops_context *);
@@ -42,6 +45,8 @@ struct namedprops_context {
 
 	const char *backend_type;
 	void *data;
+	struct namedprops_cache *cache;
+	bool defaults; /* the compiled-in default mappings match the database */
 };
 
 
@@ -60,6 +65,8 @@ __BEGIN_DECLS
 enum mapistore_error mapistore_namedprops_init(TALLOC_CTX *, struct loadparm_context *, struct namedprops_context **);
 const char *mapistore_namedprops_get_ldif_path(void);
 int mapistore_namedprops_prop_type_from_string(const char *);
+enum mapistore_error mapistore_namedprops_cache_attach(struct namedprops_context *, const char *);
+enum mapistore_error mapistore_namedprops_cache_preload(struct namedprops_context *);
 
 __END_DECLS
 
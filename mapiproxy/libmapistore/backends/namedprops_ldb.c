@@ -218,19 +218,19 @@ static enum mapistore_error next_unused_id(struct namedprops_context *nprops, ui
 	return MAPISTORE_SUCCESS;
 }
 
-static enum mapistore_error create_id(struct namedprops_context *self,
-				      struct MAPINAMEID nameid,
-				      uint16_t mapped_id)
+static enum mapistore_error add_record(struct ldb_context *ldb_ctx,
+				       struct MAPINAMEID *nameid,
+				       uint16_t mapped_id)
 {
 	TALLOC_CTX *mem_ctx = talloc_new(NULL);
 
 	char *dec_mappedid = talloc_asprintf(mem_ctx, "%u", mapped_id);
-	char *guid = GUID_string(mem_ctx, &nameid.lpguid);
+	char *guid = GUID_string(mem_ctx, &nameid->lpguid);
 	char *ldif_record, *hex_id, *dec_id;
-	switch (nameid.ulKind) {
+	switch (nameid->ulKind) {
 	case MNID_ID:
-		hex_id = talloc_asprintf(mem_ctx, "%.4x", nameid.kind.lid);
-		dec_id = talloc_asprintf(mem_ctx, "%u", nameid.kind.lid);
+		hex_id = talloc_asprintf(mem_ctx, "%.4x", nameid->kind.lid);
+		dec_id = talloc_asprintf(mem_ctx, "%u", nameid->kind.lid);
 		ldif_record = talloc_asprintf(mem_ctx,
 			"dn: CN=0x%s,CN=%s,CN=default\n"
 			"objectClass: MNID_ID\n"
@@ -250,8 +250,8 @@ static enum mapistore_error create_id(struct namedprops_context *self,
 			"oleguid: %s\n"
 			"mappedId: %s\n"
 			"propName: %s\n",
-			nameid.kind.lpwstr.Name, guid, nameid.kind.lpwstr.Name,
-			guid, dec_mappedid, nameid.kind.lpwstr.Name);
+			nameid->kind.lpwstr.Name, guid, nameid->kind.lpwstr.Name,
+			guid, dec_mappedid, nameid->kind.lpwstr.Name);
 		break;
 	default:
 		abort();
@@ -261,7 +261,6 @@ static enum mapistore_error create_id(struct namedprops_context *self,
 
 	const char *ldif_records[] = { NULL, NULL };
 	ldif_records[0] = ldif_record;
-	struct ldb_context *ldb_ctx = self->data;
 	struct ldb_ldif	*ldif = ldb_ldif_read_string(ldb_ctx, ldif_records);
 
 	struct ldb_message *normalized_msg;
@@ -273,7 +272,149 @@ static enum mapistore_error create_id(struct namedprops_context *self,
 	MAPISTORE_RETVAL_IF(ret != LDB_SUCCESS, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
 
 	talloc_free(mem_ctx);
-	return ret;
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error create_id(struct namedprops_context *self,
+				      struct MAPINAMEID nameid,
+				      uint16_t mapped_id)
+{
+	return add_record(self->data, &nameid, mapped_id);
+}
+
+/**
+   \details Map several named properties at once, in a single
+   transaction
+
+   \param self pointer to the namedprops context
+   \param count number of named properties
+   \param nameids the named properties to map
+   \param mapped_ids the property IDs to map them to
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error. On
+   error, none of the named properties is mapped.
+ */
+static enum mapistore_error create_ids(struct namedprops_context *self,
+				       uint32_t count,
+				       struct MAPINAMEID *nameids,
+				       const uint16_t *mapped_ids)
+{
+	struct ldb_context	*ldb_ctx = self->data;
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+	uint32_t		i;
+
+	if (!count) return MAPISTORE_SUCCESS;
+
+	/* nested in the caller transaction when there is one */
+	MAPISTORE_RETVAL_IF(ldb_transaction_start(ldb_ctx) != LDB_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, NULL);
+	for (i = 0; i < count; i++) {
+		retval = add_record(ldb_ctx, &nameids[i], mapped_ids[i]);
+		if (retval != MAPISTORE_SUCCESS) {
+			ldb_transaction_cancel(ldb_ctx);
+			return retval;
+		}
+	}
+	MAPISTORE_RETVAL_IF(ldb_transaction_commit(ldb_ctx) != LDB_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/* Named properties looked up with a single search */
+#define	NAMEDPROPS_LDB_BATCH	64
+
+static bool record_matches(struct ldb_message *msg, struct MAPINAMEID *nameid)
+{
+	const char	*oclass, *guid, *cn;
+	struct GUID	oleguid;
+
+	oclass = ldb_msg_find_attr_as_string(msg, "objectClass", NULL);
+	guid = ldb_msg_find_attr_as_string(msg, "oleguid", NULL);
+	cn = ldb_msg_find_attr_as_string(msg, "cn", NULL);
+	if (!oclass || !guid || !cn) return false;
+	if (!NT_STATUS_IS_OK(GUID_from_string(guid, &oleguid)) || !GUID_equal(&oleguid, &nameid->lpguid)) return false;
+
+	switch (nameid->ulKind) {
+	case MNID_ID:
+		return (!strcmp(oclass, "MNID_ID") && strtol(cn, NULL, 16) == nameid->kind.lid);
+	case MNID_STRING:
+		/* cn is matched case-insensitively by the search too */
+		return (!strcmp(oclass, "MNID_STRING") && !strcasecmp(cn, nameid->kind.lpwstr.Name));
+	}
+
+	return false;
+}
+
+/**
+   \details Look up the property IDs of several named properties,
+   with one search for each batch of NAMEDPROPS_LDB_BATCH names
+
+   \param self pointer to the namedprops context
+   \param count number of named properties
+   \param nameids the named properties to look up
+   \param mapped_ids the property IDs to return, 0 for the named
+   properties which are not mapped
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error get_mapped_ids(struct namedprops_context *self,
+					   uint32_t count,
+					   struct MAPINAMEID *nameids,
+					   uint16_t *mapped_ids)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct ldb_context	*ldb_ctx = self->data;
+	struct ldb_result	*res = NULL;
+	const char * const	attrs[] = { "objectClass", "oleguid", "cn", "mappedId", NULL };
+	char			*filter, *guid, *name;
+	uint32_t		first, last, i, j;
+	int			ret;
+
+	memset(mapped_ids, 0, count * sizeof (uint16_t));
+	for (first = 0; first < count; first = last) {
+		last = (count - first > NAMEDPROPS_LDB_BATCH) ? first + NAMEDPROPS_LDB_BATCH : count;
+
+		mem_ctx = talloc_named(NULL, 0, "namedprops_ldb_get_mapped_ids");
+		MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+		filter = talloc_strdup(mem_ctx, "(|");
+		for (i = first; filter && i < last; i++) {
+			guid = GUID_string(mem_ctx, &nameids[i].lpguid);
+			switch (nameids[i].ulKind) {
+			case MNID_ID:
+				filter = talloc_asprintf_append_buffer(filter,
+							"(&(objectClass=MNID_ID)(oleguid=%s)(cn=0x%.4x))",
+							guid, nameids[i].kind.lid);
+				break;
+			case MNID_STRING:
+				if (!nameids[i].kind.lpwstr.Name) break;
+				name = ldb_binary_encode_string(mem_ctx, nameids[i].kind.lpwstr.Name);
+				filter = talloc_asprintf_append_buffer(filter,
+							"(&(objectClass=MNID_STRING)(oleguid=%s)(cn=%s))",
+							guid, name);
+				break;
+			}
+		}
+		filter = talloc_strdup_append_buffer(filter, ")");
+		MAPISTORE_RETVAL_IF(!filter, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+		ret = ldb_search(ldb_ctx, mem_ctx, &res, ldb_get_default_basedn(ldb_ctx),
+				 LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+		MAPISTORE_RETVAL_IF(ret != LDB_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+		for (i = first; i < last; i++) {
+			if (nameids[i].ulKind == MNID_STRING && !nameids[i].kind.lpwstr.Name) continue;
+			for (j = 0; j < res->count; j++) {
+				if (record_matches(res->msgs[j], &nameids[i])) {
+					mapped_ids[i] = ldb_msg_find_attr_as_uint(res->msgs[j], "mappedId", 0);
+					break;
+				}
+			}
+		}
+
+		talloc_free(mem_ctx);
+	}
+
+	return MAPISTORE_SUCCESS;
 }
 
 static enum mapistore_error get_nameid(struct namedprops_context *self,
@@ -461,7 +602,9 @@ enum mapistore_error mapistore_namedprops_ldb_init(TALLOC_CTX *mem_ctx,
 
 	nprops->backend_type = NAMEDPROPS_BACKEND_LDB;
 	nprops->create_id = create_id;
+	nprops->create_ids = create_ids;
 	nprops->get_mapped_id = get_mapped_id;
+	nprops->get_mapped_ids = get_mapped_ids;
 	nprops->get_nameid = get_nameid;
 	nprops->get_nameid_type = get_nameid_type;
 	nprops->next_unused_id = next_unused_id;
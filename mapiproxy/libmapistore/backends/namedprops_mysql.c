@@ -174,6 +174,156 @@ static enum mapistore_error create_id(struct namedprops_context *self,
 	return MAPISTORE_SUCCESS;
 }
 
+/* Named properties looked up or inserted with a single statement */
+#define	NAMEDPROPS_MYSQL_BATCH	128
+
+/**
+   \details Map several named properties at once, with one INSERT for
+   each batch of NAMEDPROPS_MYSQL_BATCH names
+
+   \param self pointer to the namedprops context
+   \param count number of named properties
+   \param nameids the named properties to map
+   \param mapped_ids the property IDs to map them to
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error create_ids(struct namedprops_context *self,
+				       uint32_t count,
+				       struct MAPINAMEID *nameids,
+				       const uint16_t *mapped_ids)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn = self->data;
+	char		*sql, *guid;
+	uint32_t	first, last, i;
+
+	for (first = 0; first < count; first = last) {
+		last = (count - first > NAMEDPROPS_MYSQL_BATCH) ? first + NAMEDPROPS_MYSQL_BATCH : count;
+
+		mem_ctx = talloc_named(NULL, 0, "namedprops_mysql_create_ids");
+		MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+		sql = talloc_strdup(mem_ctx, "INSERT INTO " NAMEDPROPS_MYSQL_TABLE " "
+				    "(type, propType, oleguid, mappedId, propId, propName) VALUES ");
+		for (i = first; sql && i < last; i++) {
+			guid = GUID_string(mem_ctx, &nameids[i].lpguid);
+			if (nameids[i].ulKind == MNID_ID) {
+				sql = talloc_asprintf_append_buffer(sql, "%s(%d, %d, '%s', %u, %u, NULL)",
+								    (i == first) ? "" : ", ", MNID_ID, PT_NULL,
+								    guid, mapped_ids[i], nameids[i].kind.lid);
+			} else if (nameids[i].ulKind == MNID_STRING && nameids[i].kind.lpwstr.Name) {
+				sql = talloc_asprintf_append_buffer(sql, "%s(%d, %d, '%s', %u, NULL, '%s')",
+								    (i == first) ? "" : ", ", MNID_STRING, PT_NULL,
+								    guid, mapped_ids[i],
+								    _sql(mem_ctx, nameids[i].kind.lpwstr.Name));
+			} else {
+				MAPISTORE_RETVAL_IF(true, MAPISTORE_ERROR, mem_ctx);
+			}
+		}
+		MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+		OC_DEBUG(5, "Inserting %u records\n", last - first);
+		MAPISTORE_RETVAL_IF(mysql_query(conn, sql) != 0, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+		talloc_free(mem_ctx);
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+static bool row_matches(MYSQL_ROW row, struct MAPINAMEID *nameid)
+{
+	struct GUID	oleguid;
+
+	if (!row[0] || !row[1] || strtol(row[0], NULL, 10) != nameid->ulKind) return false;
+	if (!NT_STATUS_IS_OK(GUID_from_string(row[1], &oleguid)) || !GUID_equal(&oleguid, &nameid->lpguid)) return false;
+
+	switch (nameid->ulKind) {
+	case MNID_ID:
+		return (row[2] && strtoul(row[2], NULL, 10) == nameid->kind.lid);
+	case MNID_STRING:
+		/* as compared by the default collation */
+		return (row[3] && !strcasecmp(row[3], nameid->kind.lpwstr.Name));
+	}
+
+	return false;
+}
+
+/**
+   \details Look up the property IDs of several named properties, with
+   one SELECT for each batch of NAMEDPROPS_MYSQL_BATCH names
+
+   \param self pointer to the namedprops context
+   \param count number of named properties
+   \param nameids the named properties to look up
+   \param mapped_ids the property IDs to return, 0 for the named
+   properties which are not mapped
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error get_mapped_ids(struct namedprops_context *self,
+					   uint32_t count,
+					   struct MAPINAMEID *nameids,
+					   uint16_t *mapped_ids)
+{
+	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn = self->data;
+	MYSQL_RES	*res;
+	MYSQL_ROW	row;
+	char		*sql, *guid;
+	uint32_t	first, last, i;
+	bool		empty;
+
+	memset(mapped_ids, 0, count * sizeof (uint16_t));
+	for (first = 0; first < count; first = last) {
+		last = (count - first > NAMEDPROPS_MYSQL_BATCH) ? first + NAMEDPROPS_MYSQL_BATCH : count;
+
+		mem_ctx = talloc_named(NULL, 0, "namedprops_mysql_get_mapped_ids");
+		MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+		empty = true;
+		sql = talloc_strdup(mem_ctx, "SELECT type, oleguid, propId, propName, mappedId FROM "
+				    NAMEDPROPS_MYSQL_TABLE " WHERE ");
+		for (i = first; sql && i < last; i++) {
+			guid = GUID_string(mem_ctx, &nameids[i].lpguid);
+			if (nameids[i].ulKind == MNID_ID) {
+				sql = talloc_asprintf_append_buffer(sql, "%s(`type`=%d AND `oleguid`='%s' AND `propId`=%u)",
+								    empty ? "" : " OR ", MNID_ID, guid, nameids[i].kind.lid);
+			} else if (nameids[i].ulKind == MNID_STRING && nameids[i].kind.lpwstr.Name) {
+				sql = talloc_asprintf_append_buffer(sql, "%s(`type`=%d AND `oleguid`='%s' AND `propName`='%s')",
+								    empty ? "" : " OR ", MNID_STRING, guid,
+								    _sql(mem_ctx, nameids[i].kind.lpwstr.Name));
+			} else {
+				continue;
+			}
+			empty = false;
+		}
+		MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		if (empty) {
+			talloc_free(mem_ctx);
+			continue;
+		}
+
+		MAPISTORE_RETVAL_IF(mysql_query(conn, sql) != 0, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+		res = mysql_store_result(conn);
+		MAPISTORE_RETVAL_IF(!res, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+		while ((row = mysql_fetch_row(res))) {
+			for (i = first; i < last; i++) {
+				if (!mapped_ids[i] && row[4] && row_matches(row, &nameids[i])) {
+					mapped_ids[i] = strtol(row[4], NULL, 10);
+				}
+			}
+		}
+		mysql_free_result(res);
+
+		talloc_free(mem_ctx);
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
 static enum mapistore_error get_nameid(struct namedprops_context *self,
 				       uint16_t mapped_id,
 				       TALLOC_CTX *mem_ctx,
@@ -396,7 +546,9 @@ enum mapistore_error mapistore_namedprops_mysql_init(TALLOC_CTX *mem_ctx,
 	nprops->backend_type = NAMEDPROPS_BACKEND_MYSQL;
 
 	nprops->create_id = create_id;
+	nprops->create_ids = create_ids;
 	nprops->get_mapped_id = get_mapped_id;
+	nprops->get_mapped_ids = get_mapped_ids;
 	nprops->get_nameid = get_nameid;
 	nprops->get_nameid_type = get_nameid_type;
 	nprops->next_unused_id = next_unused_id;
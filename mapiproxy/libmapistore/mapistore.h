@@ -54,6 +54,7 @@
 
 /* forward declarations */
 struct mapistore_mgmt_notif;
+struct indexing_lru;
 
 typedef	int (*init_backend_fn) (void);
 
@@ -70,6 +71,33 @@ typedef	int (*init_backend_fn) (void);
 /* Default filename for named properties backend using ldb */
 #define MAPISTORE_DB_NAMED  "named_properties.ldb"
 
+/* Default number of records kept in the per-process indexing cache */
+#define	MAPISTORE_INDEXING_LRU_SIZE	4096
+/* Default number of seconds an indexing cache record is served */
+#define	MAPISTORE_INDEXING_LRU_TTL	60
+
+/* Default number of indexing contexts kept by a process */
+#define	MAPISTORE_INDEXING_CACHE_SIZE	64
+
+/* Default age in seconds after which a free/busy summary is rebuilt */
+#define	MAPISTORE_FREEBUSY_SUMMARY_MAX_AGE	900
+
+/* Bytes of each text property of a message stored in the content index */
+#define	MAPISTORE_CONTENT_INDEX_TEXT_MAX	16384
+
+/* Default age in seconds and number of entries of a deleted messages log */
+#define	MAPISTORE_TOMBSTONES_MAX_AGE	2592000
+#define	MAPISTORE_TOMBSTONES_MAX	8192
+
+/* The backend operations can run concurrently on different contexts.
+   They then run without the lock of the caller: they must only use
+   the objects of their context and not call back into libmapistore,
+   which serializes the operations run on a same context. */
+#define	MAPISTORE_BACKEND_THREAD_SAFE	0x1
+
+/* Default number of idle backend contexts kept by a process */
+#define	MAPISTORE_CONTEXT_POOL_SIZE	32
+
 struct mapistore_message {
 	/* message props */
 	char					*subject_prefix;
@@ -106,6 +134,12 @@ enum mapistore_query_type {
 	MAPISTORE_LIVEFILTERED_QUERY,
 };
 
+enum mapistore_stream_mode {
+	MAPISTORE_STREAM_READ,
+	MAPISTORE_STREAM_READWRITE,
+	MAPISTORE_STREAM_CREATE /* truncates the property */
+};
+
 /* proof of concept: a new structure to simplify property queries */
 struct mapistore_property_data {
         void *data;
@@ -153,8 +187,17 @@ struct indexing_context {
 	enum mapistore_error	(*get_uri)(struct indexing_context *, const char *, TALLOC_CTX *, uint64_t, char **, bool *);
 	enum mapistore_error	(*get_fmid)(struct indexing_context *, const char *, const char *, bool, uint64_t *, bool *);
 
+	enum mapistore_error	(*add_fmids)(struct indexing_context *, const char *, uint32_t, const uint64_t *, const char **);
+	enum mapistore_error	(*del_fmids)(struct indexing_context *, const char *, uint32_t, const uint64_t *, uint8_t);
+	enum mapistore_error	(*get_uris)(struct indexing_context *, const char *, TALLOC_CTX *, uint32_t, const uint64_t *, char **, bool *);
+
 	enum mapistore_error	(*allocate_fmid)(struct indexing_context *, const char *, uint64_t *);
 	enum mapistore_error	(*allocate_fmids)(struct indexing_context *, const char *, int, uint64_t *);
+	enum mapistore_error	(*release_fmids)(struct indexing_context *, const char *, uint64_t, int);
+
+	/* Counter moving on every change of the backend data, NULL if
+	   the backend has none */
+	uint64_t		(*get_generation)(struct indexing_context *);
 
 	/* Backend URL */
 	const char *url;
@@ -164,6 +207,12 @@ struct indexing_context {
 
 	/* Custom backend cache */
 	void *cache;
+
+	/* In-process lookup cache */
+	struct indexing_lru *lru;
+
+	/* In-process range of allocated fmids */
+	struct indexing_lease *lease;
 };
 
 struct mapistore_backend {
@@ -177,6 +226,7 @@ struct mapistore_backend {
 		enum mapistore_error	(*list_contexts)(const char *, struct indexing_context *, TALLOC_CTX *, struct mapistore_contexts_list **);
 		enum mapistore_error	(*create_context)(TALLOC_CTX *, struct mapistore_connection_info *, struct indexing_context *, const char *, void **);
 		enum mapistore_error	(*create_root_folder)(const char *, enum mapistore_context_role, uint64_t, const char *, TALLOC_CTX *, char **);
+		uint32_t		flags; /* MAPISTORE_BACKEND_* flags */
 	} backend;
 
 	/** context operations */
@@ -197,11 +247,18 @@ struct mapistore_backend {
  		enum mapistore_error	(*move_folder)(void *, void *, TALLOC_CTX *, const char *);
  		enum mapistore_error	(*copy_folder)(void *, void *, TALLOC_CTX *, bool, const char *);
 		enum mapistore_error	(*get_deleted_fmids)(void *, TALLOC_CTX *, enum mapistore_table_type, uint64_t, struct UI8Array_r **, uint64_t *);
+		enum mapistore_error	(*get_changed_fmids)(void *, TALLOC_CTX *, enum mapistore_table_type, uint64_t, struct UI8Array_r **);
 		enum mapistore_error	(*get_child_count)(void *, enum mapistore_table_type, uint32_t *);
                 enum mapistore_error	(*open_table)(void *, TALLOC_CTX *, enum mapistore_table_type, uint32_t, void **, uint32_t *);
 		enum mapistore_error	(*modify_permissions)(void *, uint8_t, uint16_t, struct PermissionData *);
 
 		enum mapistore_error	(*preload_message_bodies)(void *, enum mapistore_table_type, const struct UI8Array_r *);
+		/* optional, change the read flag of a set of messages
+		   of the folder without opening them */
+		enum mapistore_error	(*set_read_flags)(void *, uint32_t, const uint64_t *, uint8_t);
+		/* optional, delete a set of messages of the folder,
+		   skipping the ones that do not exist */
+		enum mapistore_error	(*delete_messages)(void *, uint32_t, const uint64_t *, uint8_t);
         } folder;
 
         /** oxcmsg operations */
@@ -227,6 +284,8 @@ struct mapistore_backend {
                 enum mapistore_error	(*set_restrictions)(void *, struct mapi_SRestriction *, uint8_t *);
                 enum mapistore_error	(*set_sort_order)(void *, struct SSortOrderSet *, uint8_t *);
                 enum mapistore_error	(*get_row)(void *, TALLOC_CTX *, enum mapistore_query_type, uint32_t, struct mapistore_property_data **);
+                /* optional, fetch count rows from start; returns the rows and the number actually fetched */
+                enum mapistore_error	(*get_rows)(void *, TALLOC_CTX *, enum mapistore_query_type, uint32_t, uint32_t, struct mapistore_property_data ***, uint32_t *);
                 enum mapistore_error	(*get_row_count)(void *, enum mapistore_query_type, uint32_t *);
 		enum mapistore_error	(*handle_destructor)(void *, uint32_t);
         } table;
@@ -236,8 +295,25 @@ struct mapistore_backend {
                 enum mapistore_error	(*get_available_properties)(void *, TALLOC_CTX *, struct SPropTagArray **);
                 enum mapistore_error	(*get_properties)(void *, TALLOC_CTX *, uint16_t, enum MAPITAGS *, struct mapistore_property_data *);
                 enum mapistore_error	(*set_properties)(void *, struct SRow *);
+		/* optional, NULL when properties are only read and
+		   written as a whole */
+		enum mapistore_error	(*open_property_stream)(void *, TALLOC_CTX *, enum MAPITAGS, enum mapistore_stream_mode, void **, uint64_t *);
+		/* optional, copy the properties of an object onto
+		   another object of the same context, with the
+		   recipients and attachments of messages when the
+		   last argument is true */
+		enum mapistore_error	(*copy_object)(void *, void *, struct SPropTagArray *, bool);
         } properties;
 
+	/** property stream operations, optional. Streams carry the
+	    property in its wire format (PT_UNICODE as UTF-16LE) and
+	    are closed by freeing them. */
+	struct {
+		enum mapistore_error	(*read)(void *, TALLOC_CTX *, uint64_t, uint32_t, DATA_BLOB *);
+		enum mapistore_error	(*write)(void *, uint64_t, DATA_BLOB);
+		enum mapistore_error	(*commit)(void *, uint64_t);
+	} stream;
+
 	/** manager operations */
 	struct {
 		enum mapistore_error	(*generate_uri)(TALLOC_CTX *, const char *, const char *, const char *, const char *, char **);
@@ -252,6 +328,8 @@ struct backend_context {
 	uint32_t			context_id;
 	uint32_t			ref_count;
 	char				*uri;
+	struct mapistore_connection_info *conn_info; /* owned by pooled contexts only */
+	bool				root_deleted;
 };
 
 struct backend_context_list {
@@ -262,11 +340,30 @@ struct backend_context_list {
 
 struct processing_context;
 
+struct mapistore_notification_bus;
+
 struct mapistore_notification_context {
 	memcached_st				*memc_ctx;
+	struct mapistore_notification_bus	*bus;
+	bool					local_subscriptions;
+};
+
+struct mapistore_notification_batch_entry {
+	struct GUID					uuid;
+	DATA_BLOB					payload;
+	struct mapistore_notification_batch_entry	*prev;
+	struct mapistore_notification_batch_entry	*next;
+};
+
+struct mapistore_notification_batch {
+	struct mapistore_context			*mstore_ctx;
+	struct mapistore_notification_batch_entry	*entries;
 };
 
+struct mapistore_core;
+
 struct mapistore_context {
+	struct mapistore_core			*core;
 	struct processing_context		*processing_ctx;
 	struct backend_context_list		*context_list;
 	struct indexing_context_list		*indexing_list;
@@ -293,6 +390,111 @@ struct mapistore_freebusy_properties {
 	struct FILETIME	timestamp;
 };
 
+/* Size of the conversation identifiers (PidTagConversationId) */
+#define	MAPISTORE_CONVERSATION_ID_SIZE		16
+/* Messages kept in the index of a conversation, the oldest are dropped */
+#define	MAPISTORE_CONVERSATION_MAX_MEMBERS	1024
+
+struct mapistore_conversation_member {
+	uint64_t	fid;
+	uint64_t	mid;
+	uint64_t	time; /* delivery time, NTTIME */
+};
+
+struct mapistore_freebusy_event {
+	uint64_t	mid;
+	struct FILETIME	start;
+	struct FILETIME	end;
+	uint32_t	busy_status;
+};
+
+/* Backend operations accounted by the backend profiler */
+enum mapistore_backend_op {
+	MAPISTORE_BACKEND_OP_LIST_CONTEXTS,
+	MAPISTORE_BACKEND_OP_CREATE_CONTEXT,
+	MAPISTORE_BACKEND_OP_CREATE_ROOT_FOLDER,
+	MAPISTORE_BACKEND_OP_GET_ROOT_FOLDER,
+	MAPISTORE_BACKEND_OP_GET_PATH,
+	MAPISTORE_BACKEND_OP_FOLDER_OPEN_FOLDER,
+	MAPISTORE_BACKEND_OP_FOLDER_CREATE_FOLDER,
+	MAPISTORE_BACKEND_OP_FOLDER_DELETE,
+	MAPISTORE_BACKEND_OP_FOLDER_OPEN_MESSAGE,
+	MAPISTORE_BACKEND_OP_FOLDER_CREATE_MESSAGE,
+	MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGE,
+	MAPISTORE_BACKEND_OP_FOLDER_MOVE_COPY_MESSAGES,
+	MAPISTORE_BACKEND_OP_FOLDER_MOVE_FOLDER,
+	MAPISTORE_BACKEND_OP_FOLDER_COPY_FOLDER,
+	MAPISTORE_BACKEND_OP_FOLDER_GET_DELETED_FMIDS,
+	MAPISTORE_BACKEND_OP_FOLDER_GET_CHANGED_FMIDS,
+	MAPISTORE_BACKEND_OP_FOLDER_GET_CHILD_COUNT,
+	MAPISTORE_BACKEND_OP_FOLDER_OPEN_TABLE,
+	MAPISTORE_BACKEND_OP_FOLDER_MODIFY_PERMISSIONS,
+	MAPISTORE_BACKEND_OP_FOLDER_PRELOAD_MESSAGE_BODIES,
+	MAPISTORE_BACKEND_OP_FOLDER_SET_READ_FLAGS,
+	MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGES,
+	MAPISTORE_BACKEND_OP_MESSAGE_GET_MESSAGE_DATA,
+	MAPISTORE_BACKEND_OP_MESSAGE_MODIFY_RECIPIENTS,
+	MAPISTORE_BACKEND_OP_MESSAGE_SET_READ_FLAG,
+	MAPISTORE_BACKEND_OP_MESSAGE_SAVE,
+	MAPISTORE_BACKEND_OP_MESSAGE_SUBMIT,
+	MAPISTORE_BACKEND_OP_MESSAGE_OPEN_ATTACHMENT,
+	MAPISTORE_BACKEND_OP_MESSAGE_CREATE_ATTACHMENT,
+	MAPISTORE_BACKEND_OP_MESSAGE_GET_ATTACHMENT_TABLE,
+	MAPISTORE_BACKEND_OP_MESSAGE_OPEN_EMBEDDED_MESSAGE,
+	MAPISTORE_BACKEND_OP_MESSAGE_CREATE_EMBEDDED_MESSAGE,
+	MAPISTORE_BACKEND_OP_TABLE_GET_AVAILABLE_PROPERTIES,
+	MAPISTORE_BACKEND_OP_TABLE_SET_COLUMNS,
+	MAPISTORE_BACKEND_OP_TABLE_SET_RESTRICTIONS,
+	MAPISTORE_BACKEND_OP_TABLE_SET_SORT_ORDER,
+	MAPISTORE_BACKEND_OP_TABLE_GET_ROW,
+	MAPISTORE_BACKEND_OP_TABLE_GET_ROWS,
+	MAPISTORE_BACKEND_OP_TABLE_GET_ROW_COUNT,
+	MAPISTORE_BACKEND_OP_TABLE_HANDLE_DESTRUCTOR,
+	MAPISTORE_BACKEND_OP_PROPERTIES_GET_AVAILABLE_PROPERTIES,
+	MAPISTORE_BACKEND_OP_PROPERTIES_GET_PROPERTIES,
+	MAPISTORE_BACKEND_OP_PROPERTIES_SET_PROPERTIES,
+	MAPISTORE_BACKEND_OP_PROPERTIES_OPEN_PROPERTY_STREAM,
+	MAPISTORE_BACKEND_OP_PROPERTIES_COPY_OBJECT,
+	MAPISTORE_BACKEND_OP_STREAM_READ,
+	MAPISTORE_BACKEND_OP_STREAM_WRITE,
+	MAPISTORE_BACKEND_OP_STREAM_COMMIT,
+	MAPISTORE_BACKEND_OP_MANAGER_GENERATE_URI,
+	MAPISTORE_BACKEND_OP_MAX
+};
+
+/* Latency histogram buckets: <1us, then [2^(b-1), 2^b) us, the last one holds everything above */
+#define	MAPISTORE_BACKEND_PROFILE_BUCKETS	24
+
+struct mapistore_backend_op_stats {
+	uint64_t	count;
+	uint64_t	errors;
+	uint64_t	total_usec;
+	uint64_t	max_usec;
+	uint64_t	buckets[MAPISTORE_BACKEND_PROFILE_BUCKETS];
+};
+
+/* Backends accounted in the shared statistics */
+#define	MAPISTORE_SHARED_STATS_BACKENDS		8
+
+/* Counters of a backend in the shared statistics, the slot is free
+ * while name is empty */
+struct mapistore_shared_backend_stats {
+	char					name[32];
+	struct mapistore_backend_op_stats	ops[MAPISTORE_BACKEND_OP_MAX];
+};
+
+/* Layout of the statistics mapistore maintains in an area shared with
+ * other processes, see mapistore_set_shared_stats */
+struct mapistore_shared_stats {
+	uint32_t				backends;	/* MAPISTORE_SHARED_STATS_BACKENDS */
+	uint32_t				ops;		/* MAPISTORE_BACKEND_OP_MAX */
+	uint32_t				buckets;	/* MAPISTORE_BACKEND_PROFILE_BUCKETS */
+	uint32_t				reserved;
+	uint64_t				indexing_hits;
+	uint64_t				indexing_misses;
+	struct mapistore_shared_backend_stats	backend[MAPISTORE_SHARED_STATS_BACKENDS];
+};
+
 #ifndef __BEGIN_DECLS
 #ifdef __cplusplus
 #define __BEGIN_DECLS		extern "C" {
@@ -312,6 +514,7 @@ int mapistore_getprops(struct mapistore_context *, uint32_t, TALLOC_CTX *, uint6
 int mapistore_setprops(struct mapistore_context *, uint32_t, uint64_t, uint8_t, struct SRow *);
 
 struct mapistore_context *mapistore_init(TALLOC_CTX *, struct loadparm_context *, const char *);
+enum mapistore_error mapistore_warmup(struct loadparm_context *, const char *);
 void mapistore_set_default_indexing_url(const char *);
 void mapistore_set_default_cache_url(const char *);
 char *mapistore_get_default_cache_url(void);
@@ -336,13 +539,17 @@ enum mapistore_error mapistore_folder_move_copy_messages(struct mapistore_contex
 enum mapistore_error mapistore_folder_move_folder(struct mapistore_context *, uint32_t, void *, void *, TALLOC_CTX *, const char *);
 enum mapistore_error mapistore_folder_copy_folder(struct mapistore_context *, uint32_t, void *, void *, TALLOC_CTX *, bool, const char *);
 enum mapistore_error mapistore_folder_get_deleted_fmids(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, enum mapistore_table_type, uint64_t, struct UI8Array_r **, uint64_t *);
+enum mapistore_error mapistore_folder_get_changed_fmids(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, enum mapistore_table_type, uint64_t, struct UI8Array_r **);
 enum mapistore_error mapistore_folder_get_child_count(struct mapistore_context *, uint32_t, void *, enum mapistore_table_type, uint32_t *);
 enum mapistore_error mapistore_folder_get_child_fmids(struct mapistore_context *, uint32_t, void *, enum mapistore_table_type, TALLOC_CTX *, uint64_t **, uint32_t *);
 enum mapistore_error mapistore_folder_get_child_fid_by_name(struct mapistore_context *, uint32_t, void *, const char *, uint64_t *);
 enum mapistore_error mapistore_folder_open_table(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, enum mapistore_table_type, uint32_t, void **, uint32_t *);
 enum mapistore_error mapistore_folder_modify_permissions(struct mapistore_context *, uint32_t, void *, uint8_t, uint16_t, struct PermissionData *);
 enum mapistore_error mapistore_folder_preload_message_bodies(struct mapistore_context *, uint32_t, void *, enum mapistore_table_type, const struct UI8Array_r *);
+enum mapistore_error mapistore_folder_set_read_flags(struct mapistore_context *, uint32_t, void *, uint32_t, const uint64_t *, uint8_t);
+enum mapistore_error mapistore_folder_delete_messages(struct mapistore_context *, uint32_t, void *, uint32_t, const uint64_t *, uint8_t);
 enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore_context *, uint32_t, void *, struct tm *, struct tm *, TALLOC_CTX *, struct mapistore_freebusy_properties **);
+enum mapistore_error mapistore_folder_fetch_freebusy_summary(struct mapistore_context *, uint32_t, void *, const char *, uint64_t, TALLOC_CTX *, struct mapistore_freebusy_properties **);
 
 enum mapistore_error mapistore_message_get_message_data(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, struct mapistore_message **);
 enum mapistore_error mapistore_message_modify_recipients(struct mapistore_context *, uint32_t, void *, struct SPropTagArray *, uint16_t, struct mapistore_message_recipient *);
@@ -360,12 +567,19 @@ enum mapistore_error mapistore_table_set_columns(struct mapistore_context *, uin
 enum mapistore_error mapistore_table_set_restrictions(struct mapistore_context *, uint32_t, void *, struct mapi_SRestriction *, uint8_t *);
 enum mapistore_error mapistore_table_set_sort_order(struct mapistore_context *, uint32_t, void *, struct SSortOrderSet *, uint8_t *);
 enum mapistore_error mapistore_table_get_row(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, enum mapistore_query_type, uint32_t, struct mapistore_property_data **);
+enum mapistore_error mapistore_table_get_rows(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, enum mapistore_query_type, uint32_t, uint32_t, struct mapistore_property_data ***, uint32_t *);
 enum mapistore_error mapistore_table_get_row_count(struct mapistore_context *, uint32_t, void *, enum mapistore_query_type, uint32_t *);
 enum mapistore_error mapistore_table_handle_destructor(struct mapistore_context *, uint32_t, void *, uint32_t);
 
 enum mapistore_error mapistore_properties_get_available_properties(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, struct SPropTagArray **);
 enum mapistore_error mapistore_properties_get_properties(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, uint16_t, enum MAPITAGS *, struct mapistore_property_data *);
 enum mapistore_error mapistore_properties_set_properties(struct mapistore_context *, uint32_t, void *, struct SRow *);
+enum mapistore_error mapistore_properties_open_property_stream(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, enum MAPITAGS, enum mapistore_stream_mode, void **, uint64_t *);
+enum mapistore_error mapistore_properties_copy_object(struct mapistore_context *, uint32_t, void *, void *, struct SPropTagArray *, bool);
+
+enum mapistore_error mapistore_stream_read(struct mapistore_context *, uint32_t, void *, TALLOC_CTX *, uint64_t, uint32_t, DATA_BLOB *);
+enum mapistore_error mapistore_stream_write(struct mapistore_context *, uint32_t, void *, uint64_t, DATA_BLOB);
+enum mapistore_error mapistore_stream_commit(struct mapistore_context *, uint32_t, void *, uint64_t);
 
 enum MAPISTATUS mapistore_error_to_mapi(enum mapistore_error);
 enum mapistore_error mapi_error_to_mapistore(enum MAPISTATUS);
@@ -377,10 +591,12 @@ enum mapistore_error mapistore_set_mapping_path(const char *);
 enum mapistore_error mapistore_backend_register(const void *);
 const char	*mapistore_backend_get_installdir(void);
 init_backend_fn	*mapistore_backend_load(TALLOC_CTX *, const char *);
-struct backend_context *mapistore_backend_lookup(struct backend_context_list *, uint32_t);
-struct backend_context *mapistore_backend_lookup_by_uri(struct backend_context_list *, const char *);
+struct backend_context *mapistore_backend_lookup(struct mapistore_context *, uint32_t);
+struct backend_context *mapistore_backend_lookup_by_uri(struct mapistore_context *, const char *);
 struct backend_context *mapistore_backend_lookup_by_name(TALLOC_CTX *, const char *);
 bool		mapistore_backend_run_init(init_backend_fn *);
+void		mapistore_set_backend_call_hooks(bool (*)(void), void (*)(void));
+enum mapistore_error mapistore_backend_thread_safe(bool *);
 
 /* definitions from mapistore_backend_defaults */
 enum mapistore_error mapistore_backend_init_defaults(struct mapistore_backend *);
@@ -393,13 +609,75 @@ enum mapistore_error mapistore_indexing_record_del_mid(struct mapistore_context
 enum mapistore_error mapistore_indexing_record_add_fmid_for_uri(struct mapistore_context *, uint32_t, const char *, uint64_t, const char *);
 enum mapistore_error mapistore_indexing_record_get_uri(struct mapistore_context *, const char *, TALLOC_CTX *, uint64_t, char **, bool *);
 enum mapistore_error mapistore_indexing_record_get_fmid(struct mapistore_context *, const char *, const char *, bool, uint64_t *, bool *);
+enum mapistore_error mapistore_indexing_record_add_fmids(struct mapistore_context *, uint32_t, const char *, uint32_t, const uint64_t *, const char **);
+enum mapistore_error mapistore_indexing_record_del_fmids(struct mapistore_context *, uint32_t, const char *, uint32_t, const uint64_t *, uint8_t);
+enum mapistore_error mapistore_indexing_record_get_uris(struct mapistore_context *, const char *, TALLOC_CTX *, uint32_t, const uint64_t *, char **, bool *);
+void mapistore_set_default_indexing_lru_size(uint32_t);
+void mapistore_set_default_indexing_lru_ttl(uint32_t);
+void mapistore_set_indexing_cache_size(uint32_t);
+enum mapistore_error mapistore_indexing_lru_init(struct indexing_context *, uint32_t);
+enum mapistore_error mapistore_indexing_lru_stats(struct indexing_context *, uint64_t *, uint64_t *);
+void mapistore_set_default_fmid_lease_size(uint32_t);
+enum mapistore_error mapistore_indexing_lease_init(struct indexing_context *, uint32_t);
 
 enum mapistore_error mapistore_indexing_get_new_folderID(struct mapistore_context *, uint64_t *);
 enum mapistore_error mapistore_indexing_get_new_folderID_as_user(struct mapistore_context *, const char *, uint64_t *);
 enum mapistore_error mapistore_indexing_get_new_folderIDs(struct mapistore_context *, TALLOC_CTX *, uint64_t, struct UI8Array_r **);
 enum mapistore_error mapistore_indexing_reserve_fmid_range(struct mapistore_context *, uint64_t, uint64_t *);
 
+/* definitions from mapistore_freebusy.c */
+void mapistore_set_freebusy_summary_max_age(uint32_t);
+bool mapistore_freebusy_summary_exists(struct mapistore_context *, const char *, uint64_t);
+enum mapistore_error mapistore_freebusy_summary_update_event(struct mapistore_context *, const char *, uint64_t, const struct mapistore_freebusy_event *);
+enum mapistore_error mapistore_freebusy_summary_delete_events(struct mapistore_context *, const char *, uint64_t, uint32_t, const uint64_t *);
+enum mapistore_error mapistore_freebusy_summary_invalidate(struct mapistore_context *, const char *, uint64_t);
+
+/* definitions from mapistore_content_index.c */
+void mapistore_set_content_index(bool);
+enum mapistore_error mapistore_content_index_get_proptags(TALLOC_CTX *, struct SPropTagArray **);
+bool mapistore_content_index_folder_exists(struct mapistore_context *, const char *, uint64_t);
+enum mapistore_error mapistore_content_index_folder_reset(struct mapistore_context *, const char *, uint64_t);
+enum mapistore_error mapistore_content_index_folder_invalidate(struct mapistore_context *, const char *, uint64_t);
+enum mapistore_error mapistore_content_index_add(struct mapistore_context *, const char *, uint64_t, uint64_t, uint32_t, const enum MAPITAGS *, const char * const *, bool);
+enum mapistore_error mapistore_content_index_del(struct mapistore_context *, const char *, uint64_t, uint32_t, const uint64_t *);
+enum mapistore_error mapistore_content_index_query(TALLOC_CTX *, struct mapistore_context *, const char *, uint64_t, const struct mapi_SRestriction *, uint64_t **, uint32_t *);
+
+/* definitions from mapistore_tombstones.c */
+void mapistore_set_tombstones(bool, uint32_t);
+bool mapistore_tombstones_enabled(void);
+enum mapistore_error mapistore_tombstones_add(struct mapistore_context *, const char *, uint64_t, uint64_t, uint32_t, const uint64_t *);
+enum mapistore_error mapistore_tombstones_folder_reset(struct mapistore_context *, const char *, uint64_t);
+enum mapistore_error mapistore_tombstones_get(TALLOC_CTX *, struct mapistore_context *, const char *, uint64_t, uint64_t, struct UI8Array_r **, uint64_t *);
+
+/* definitions from mapistore_attachments.c */
+void mapistore_set_attachment_store(bool);
+bool mapistore_attachment_store_enabled(void);
+enum mapistore_error mapistore_attachment_store_put(TALLOC_CTX *, struct mapistore_context *, DATA_BLOB, char **);
+enum mapistore_error mapistore_attachment_store_release(struct mapistore_context *, const char *);
+enum mapistore_error mapistore_attachment_store_get_size(struct mapistore_context *, const char *, uint64_t *);
+enum mapistore_error mapistore_attachment_store_read(TALLOC_CTX *, struct mapistore_context *, const char *, uint64_t, uint32_t, DATA_BLOB *);
+
+/* definitions from mapistore_conversations.c */
+void mapistore_set_conversations(bool);
+bool mapistore_conversations_enabled(void);
+enum mapistore_error mapistore_conversations_add(struct mapistore_context *, const char *, const uint8_t *, uint64_t, uint64_t, uint64_t);
+enum mapistore_error mapistore_conversations_copy(struct mapistore_context *, const char *, uint64_t, uint32_t, const uint64_t *, const uint64_t *, bool);
+enum mapistore_error mapistore_conversations_del(struct mapistore_context *, const char *, uint32_t, const uint64_t *);
+enum mapistore_error mapistore_conversations_get_id(struct mapistore_context *, const char *, uint64_t, uint8_t *);
+enum mapistore_error mapistore_conversations_get(TALLOC_CTX *, struct mapistore_context *, const char *, const uint8_t *, struct mapistore_conversation_member **, uint32_t *);
+
+/* definitions from mapistore_context_pool.c */
+void mapistore_set_context_pool(uint32_t, uint32_t);
+
+/* definitions from mapistore_profile.c */
+void mapistore_set_backend_profiling(bool, uint32_t);
+const char *mapistore_backend_op_name(enum mapistore_backend_op);
+enum mapistore_error mapistore_backend_profile_get(const char *, enum mapistore_backend_op, struct mapistore_backend_op_stats *);
+void mapistore_backend_profile_dump(void);
+bool mapistore_set_shared_stats(void *, size_t);
+
 /* definitions from mapistore_replica_mapping.c */
+void mapistore_set_default_replica_mapping_url(const char *);
 enum mapistore_error mapistore_replica_mapping_add(struct mapistore_context *, const char *, struct replica_mapping_context_list **);
 enum mapistore_error mapistore_replica_mapping_guid_to_replid(struct mapistore_context *, const char *username, const struct GUID *, uint16_t *);
 enum mapistore_error mapistore_replica_mapping_replid_to_guid(struct mapistore_context *, const char *username, uint16_t, struct GUID *);
@@ -410,6 +688,8 @@ struct namedprops_context;
 enum mapistore_error mapistore_namedprops_get_mapped_id(struct namedprops_context *, struct MAPINAMEID, uint16_t *);
 enum mapistore_error mapistore_namedprops_next_unused_id(struct namedprops_context *, uint16_t *);
 enum mapistore_error mapistore_namedprops_create_id(struct namedprops_context *, struct MAPINAMEID, uint16_t);
+enum mapistore_error mapistore_namedprops_get_mapped_ids(struct namedprops_context *, uint32_t, struct MAPINAMEID *, uint16_t *);
+enum mapistore_error mapistore_namedprops_create_ids(struct namedprops_context *, uint32_t, struct MAPINAMEID *, const uint16_t *);
 enum mapistore_error mapistore_namedprops_get_nameid(struct namedprops_context *, uint16_t, TALLOC_CTX *mem_ctx, struct MAPINAMEID **);
 enum mapistore_error mapistore_namedprops_get_nameid_type(struct namedprops_context *, uint16_t, uint16_t *);
 enum mapistore_error mapistore_namedprops_transaction_start(struct namedprops_context *);
@@ -437,7 +717,18 @@ enum mapistore_error mapistore_notification_deliver_exist(struct mapistore_conte
 enum mapistore_error mapistore_notification_deliver_get(TALLOC_CTX *, struct mapistore_context *, struct GUID, uint8_t **, size_t *);
 enum mapistore_error mapistore_notification_deliver_delete(struct mapistore_context *, struct GUID);
 
-enum mapistore_error mapistore_notification_payload_newmail(TALLOC_CTX *, char *, char *, char *, char, uint8_t **, size_t *);
+enum mapistore_error mapistore_notification_batch_init(TALLOC_CTX *, struct mapistore_context *, struct mapistore_notification_batch **);
+enum mapistore_error mapistore_notification_batch_deliver_add(struct mapistore_notification_batch *, struct GUID, uint8_t *, size_t);
+enum mapistore_error mapistore_notification_batch_commit(struct mapistore_notification_batch *);
+
+/* definitions from mapistore_notification_bus.c */
+enum mapistore_error mapistore_notification_bus_subscribe(struct mapistore_context *, struct GUID);
+enum mapistore_error mapistore_notification_bus_unsubscribe(struct mapistore_context *, struct GUID);
+enum mapistore_error mapistore_notification_bus_publish(struct mapistore_context *, struct GUID, const uint8_t *, size_t);
+enum mapistore_error mapistore_notification_bus_fetch(TALLOC_CTX *, struct mapistore_context *, struct GUID, uint8_t **, size_t *);
+enum mapistore_error mapistore_notification_bus_refresh(struct mapistore_context *);
+
+enum mapistore_error mapistore_notification_payload_newmail(TALLOC_CTX *, char *, char *, char *, char *, char, uint8_t **, size_t *);
 
 __END_DECLS
 
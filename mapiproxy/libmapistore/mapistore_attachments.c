@@ -0,0 +1,500 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_attachments.c
+
+   \brief Single-instance attachment store
+
+   Backends saving attachment data may hand it to this store instead
+   of keeping their own copy: identical contents, such as the
+   attachment of a message sent to many mailboxes, are stored once in
+   the attachments directory of the mapistore mapping path and shared
+   by every mailbox.
+
+   A blob is named after the hash and the size of its content,
+   followed by a slot number telling apart different contents with the
+   same hash. Storing a content compares it with the blobs of its slots
+   before taking a reference, so hash collisions never mix contents.
+   The reference counts live in a TDB file next to the blobs, and each
+   hash is updated with its chain locked, so several processes may
+   store and release the same content.
+
+   Backends keep the returned key in place of the data, read the data
+   back in pieces from their property streams with
+   mapistore_attachment_store_read, and release the key when the
+   attachment is deleted.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+#include "libmapi/libmapi_private.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
+
+#include <tdb.h>
+
+#define	MAPISTORE_ATTACHMENTS_DIR	"attachments"
+#define	MAPISTORE_ATTACHMENTS_MAX_SLOTS	16
+
+static bool	attachment_store_enabled = false;
+
+/**
+   \details Configure the single-instance attachment store
+
+   \param enabled whether backends should store attachment data in it
+ */
+_PUBLIC_ void mapistore_set_attachment_store(bool enabled)
+{
+	attachment_store_enabled = enabled;
+}
+
+/**
+   \details Tell whether the single-instance attachment store is
+   enabled
+
+   \return true if backends should store attachment data in it,
+   otherwise false
+ */
+_PUBLIC_ bool mapistore_attachment_store_enabled(void)
+{
+	return attachment_store_enabled;
+}
+
+static struct tdb_context *mapistore_attachment_store_open(TALLOC_CTX *mem_ctx)
+{
+	struct tdb_context	*tdb;
+	char			*dbpath;
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/" MAPISTORE_ATTACHMENTS_DIR, mapistore_get_mapping_path());
+	if (!dbpath) return NULL;
+	mkdir(dbpath, 0700);
+	talloc_free(dbpath);
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/" MAPISTORE_ATTACHMENTS_DIR "/" MAPISTORE_DB_ATTACHMENTS,
+				 mapistore_get_mapping_path());
+	if (!dbpath) return NULL;
+
+	tdb = tdb_open(dbpath, 0, 0, O_RDWR|O_CREAT, 0600);
+	if (!tdb) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
+	}
+	talloc_free(dbpath);
+
+	return tdb;
+}
+
+/**
+   \details Return the path of the blob of a key, blobs are spread in
+   256 subdirectories after the first byte of their hash
+ */
+static char *mapistore_attachment_store_path(TALLOC_CTX *mem_ctx, const char *key, bool create)
+{
+	char	*path;
+
+	path = talloc_asprintf(mem_ctx, "%s/" MAPISTORE_ATTACHMENTS_DIR "/%.2s", mapistore_get_mapping_path(), key);
+	if (!path) return NULL;
+	if (create) {
+		mkdir(path, 0700);
+	}
+
+	return talloc_asprintf_append(path, "/%s", key);
+}
+
+/**
+   \details Check a key was returned by mapistore_attachment_store_put:
+   it names a file of the store, so it must not reach other directories
+ */
+static bool mapistore_attachment_store_key_valid(const char *key)
+{
+	size_t	i;
+
+	if (!key || strlen(key) < 3) return false;
+	for (i = 0; key[i]; i++) {
+		if (!strchr("0123456789abcdef-", key[i])) return false;
+	}
+
+	return true;
+}
+
+/**
+   \details Return the hash part of a key, which the chain lock of all
+   its slots is taken on
+ */
+static TDB_DATA mapistore_attachment_store_lock_key(const char *key)
+{
+	TDB_DATA	lock_key;
+	const char	*slot;
+
+	slot = strrchr(key, '-');
+	lock_key.dptr = discard_const_p(uint8_t, key);
+	lock_key.dsize = slot ? slot - key : strlen(key);
+
+	return lock_key;
+}
+
+static uint32_t mapistore_attachment_store_refcount(struct tdb_context *tdb, const char *key)
+{
+	TDB_DATA	data;
+	uint32_t	refcount = 0;
+
+	data = tdb_fetch_bystring(tdb, key);
+	if (data.dptr && data.dsize == 4) {
+		refcount = data.dptr[0] | (data.dptr[1] << 8) | (data.dptr[2] << 16) | ((uint32_t) data.dptr[3] << 24);
+	}
+	free(data.dptr);
+
+	return refcount;
+}
+
+static int mapistore_attachment_store_set_refcount(struct tdb_context *tdb, const char *key, uint32_t refcount)
+{
+	TDB_DATA	data;
+	uint8_t		buffer[4];
+
+	if (!refcount) {
+		return tdb_delete_bystring(tdb, key);
+	}
+
+	buffer[0] = refcount & 0xff;
+	buffer[1] = (refcount >> 8) & 0xff;
+	buffer[2] = (refcount >> 16) & 0xff;
+	buffer[3] = (refcount >> 24) & 0xff;
+	data.dptr = buffer;
+	data.dsize = sizeof (buffer);
+
+	return tdb_store_bystring(tdb, key, data, TDB_REPLACE);
+}
+
+/**
+   \details Compare the blob of a slot with a content
+ */
+static bool mapistore_attachment_store_match(const char *path, DATA_BLOB data)
+{
+	uint8_t		buffer[8192];
+	struct stat	sb;
+	size_t		offset = 0;
+	ssize_t		len;
+	int		fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) return false;
+	if (fstat(fd, &sb) == -1 || sb.st_size != data.length) {
+		close(fd);
+		return false;
+	}
+
+	while (offset < data.length) {
+		len = read(fd, buffer, sizeof (buffer));
+		if (len <= 0 || offset + len > data.length || memcmp(buffer, data.data + offset, len)) {
+			close(fd);
+			return false;
+		}
+		offset += len;
+	}
+	close(fd);
+
+	return true;
+}
+
+/**
+   \details Write the blob of a slot, renamed in place once complete so
+   readers never see partial contents
+ */
+static enum mapistore_error mapistore_attachment_store_write(TALLOC_CTX *mem_ctx, const char *path, DATA_BLOB data)
+{
+	char	*tmp_path;
+	size_t	offset = 0;
+	ssize_t	len;
+	int	fd;
+	int	ret;
+
+	tmp_path = talloc_asprintf(mem_ctx, "%s.%d", path, (int) getpid());
+	MAPISTORE_RETVAL_IF(!tmp_path, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	fd = open(tmp_path, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd == -1) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), tmp_path);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+	while (offset < data.length) {
+		len = write(fd, data.data + offset, data.length - offset);
+		if (len <= 0) {
+			OC_DEBUG(3, "%s (%s)", strerror(errno), tmp_path);
+			close(fd);
+			unlink(tmp_path);
+			return MAPISTORE_ERR_DATABASE_OPS;
+		}
+		offset += len;
+	}
+	ret = fsync(fd);
+	if (close(fd) == -1) {
+		ret = -1;
+	}
+	if (ret == -1 || rename(tmp_path, path) == -1) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), tmp_path);
+		unlink(tmp_path);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Store an attachment content, or take one more reference on
+   it if it is already stored
+
+   \param mem_ctx pointer to the memory context the key is allocated on
+   \param mstore_ctx pointer to the mapistore context
+   \param data the attachment content
+   \param keyp pointer to the returned key
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_AVAILABLE if
+   the store is disabled, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_attachment_store_put(TALLOC_CTX *mem_ctx, struct mapistore_context *mstore_ctx,
+							     DATA_BLOB data, char **keyp)
+{
+	TALLOC_CTX		*local_mem_ctx;
+	struct tdb_context	*tdb;
+	TDB_DATA		lock_key;
+	char			*hash;
+	char			*key = NULL;
+	char			*path;
+	uint32_t		refcount;
+	uint32_t		slot;
+	enum mapistore_error	retval;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!keyp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(data.length && !data.data, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!attachment_store_enabled, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_attachment_store_open(local_mem_ctx);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, local_mem_ctx);
+
+	hash = talloc_asprintf(local_mem_ctx, "%.16"PRIx64"%.8zx",
+			       hash64_stable(data.data, data.length, 0), data.length);
+	if (!hash) {
+		tdb_close(tdb);
+		talloc_free(local_mem_ctx);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	lock_key = mapistore_attachment_store_lock_key(hash);
+	if (tdb_chainlock(tdb, lock_key)) {
+		tdb_close(tdb);
+		talloc_free(local_mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	retval = MAPISTORE_ERR_EXIST;
+	for (slot = 0; slot < MAPISTORE_ATTACHMENTS_MAX_SLOTS; slot++) {
+		key = talloc_asprintf(local_mem_ctx, "%s-%x", hash, slot);
+		path = key ? mapistore_attachment_store_path(local_mem_ctx, key, true) : NULL;
+		if (!path) {
+			retval = MAPISTORE_ERR_NO_MEMORY;
+			break;
+		}
+
+		refcount = mapistore_attachment_store_refcount(tdb, key);
+		if (!refcount) {
+			/* Free slot, store the content there */
+			retval = mapistore_attachment_store_write(local_mem_ctx, path, data);
+			if (retval == MAPISTORE_SUCCESS && mapistore_attachment_store_set_refcount(tdb, key, 1)) {
+				unlink(path);
+				retval = MAPISTORE_ERR_DATABASE_OPS;
+			}
+			break;
+		}
+		if (mapistore_attachment_store_match(path, data)) {
+			retval = MAPISTORE_SUCCESS;
+			if (mapistore_attachment_store_set_refcount(tdb, key, refcount + 1)) {
+				retval = MAPISTORE_ERR_DATABASE_OPS;
+			}
+			break;
+		}
+	}
+
+	tdb_chainunlock(tdb, lock_key);
+	tdb_close(tdb);
+
+	if (retval == MAPISTORE_SUCCESS) {
+		*keyp = talloc_steal(mem_ctx, key);
+	}
+	talloc_free(local_mem_ctx);
+
+	return retval;
+}
+
+/**
+   \details Release a reference on a stored attachment content, the
+   content is deleted with its last reference
+
+   \param mstore_ctx pointer to the mapistore context
+   \param key the key returned by mapistore_attachment_store_put
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if the
+   content is not stored, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_attachment_store_release(struct mapistore_context *mstore_ctx, const char *key)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	TDB_DATA		lock_key;
+	char			*path;
+	uint32_t		refcount;
+	enum mapistore_error	retval = MAPISTORE_SUCCESS;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!mapistore_attachment_store_key_valid(key), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	path = mapistore_attachment_store_path(mem_ctx, key, false);
+	MAPISTORE_RETVAL_IF(!path, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	tdb = mapistore_attachment_store_open(mem_ctx);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
+
+	lock_key = mapistore_attachment_store_lock_key(key);
+	if (tdb_chainlock(tdb, lock_key)) {
+		tdb_close(tdb);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	refcount = mapistore_attachment_store_refcount(tdb, key);
+	if (!refcount) {
+		retval = MAPISTORE_ERR_NOT_FOUND;
+	}
+	else if (mapistore_attachment_store_set_refcount(tdb, key, refcount - 1)) {
+		retval = MAPISTORE_ERR_DATABASE_OPS;
+	}
+	else if (refcount == 1) {
+		unlink(path);
+	}
+
+	tdb_chainunlock(tdb, lock_key);
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return retval;
+}
+
+/**
+   \details Return the size of a stored attachment content
+
+   \param mstore_ctx pointer to the mapistore context
+   \param key the key returned by mapistore_attachment_store_put
+   \param sizep pointer to the returned size
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_attachment_store_get_size(struct mapistore_context *mstore_ctx, const char *key,
+								  uint64_t *sizep)
+{
+	struct stat	sb;
+	char		*path;
+	int		ret;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!mapistore_attachment_store_key_valid(key), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!sizep, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	path = mapistore_attachment_store_path(NULL, key, false);
+	MAPISTORE_RETVAL_IF(!path, MAPISTORE_ERR_NO_MEMORY, NULL);
+	ret = stat(path, &sb);
+	talloc_free(path);
+	MAPISTORE_RETVAL_IF(ret == -1, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	*sizep = sb.st_size;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Read a piece of a stored attachment content, for the
+   property streams of the backends
+
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param key the key returned by mapistore_attachment_store_put
+   \param offset the position of the first byte to read
+   \param length the maximum number of bytes to read
+   \param datap pointer to the returned data, shorter than length at
+   the end of the content
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_attachment_store_read(TALLOC_CTX *mem_ctx, struct mapistore_context *mstore_ctx,
+							      const char *key, uint64_t offset, uint32_t length,
+							      DATA_BLOB *datap)
+{
+	DATA_BLOB	data;
+	char		*path;
+	size_t		done = 0;
+	ssize_t		len;
+	int		fd;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!mapistore_attachment_store_key_valid(key), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!datap, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	path = mapistore_attachment_store_path(NULL, key, false);
+	MAPISTORE_RETVAL_IF(!path, MAPISTORE_ERR_NO_MEMORY, NULL);
+	fd = open(path, O_RDONLY);
+	talloc_free(path);
+	MAPISTORE_RETVAL_IF(fd == -1, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	data = data_blob_talloc(mem_ctx, NULL, length);
+	if (length && !data.data) {
+		close(fd);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	while (done < length) {
+		len = pread(fd, data.data + done, length - done, offset + done);
+		if (len == -1) {
+			close(fd);
+			data_blob_free(&data);
+			return MAPISTORE_ERR_DATABASE_OPS;
+		}
+		if (len == 0) break;
+		done += len;
+	}
+	close(fd);
+
+	data.length = done;
+	*datap = data;
+
+	return MAPISTORE_SUCCESS;
+}
@@ -32,6 +32,11 @@
 #include "mapistore_errors.h"
 #include "mapistore_private.h"
 #include "utils/dlinklist.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
+
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
 
 
 /**
@@ -41,13 +46,138 @@
  */
 
 
+/* Call a backend operation, account it in the backend profiler and return its result */
+#define	MAPISTORE_BACKEND_RETURN(bctx, op, call)					\
+	do {										\
+		struct timespec		_start;						\
+		enum mapistore_error	_ret;						\
+		bool			_released;					\
+											\
+		mapistore_backend_profile_start(&_start);				\
+		_released = mapistore_backend_call_leave(bctx);			\
+		_ret = (call);								\
+		mapistore_backend_call_enter(bctx, _released);			\
+		return mapistore_backend_profile_end((bctx)->backend, (op), (bctx)->uri, &_start, _ret); \
+	} while (0)
+
+/* Hooks run around the operations of thread safe backends */
+static bool	(*backend_call_leave)(void) = NULL;
+static void	(*backend_call_enter)(void) = NULL;
+
+#if defined(HAVE_PTHREADS)
+/* Serialize the operations run on a context once the hooks let other
+ * threads in: contexts may be shared by several sessions */
+#define	MAPISTORE_BACKEND_CALL_LOCKS	64
+static pthread_mutex_t	backend_call_locks[MAPISTORE_BACKEND_CALL_LOCKS];
+static pthread_once_t	backend_call_locks_once = PTHREAD_ONCE_INIT;
+#endif
+
 static struct mstore_backend {
 	struct mapistore_backend	*backend;
+	bool				initialized;	/* init() ran in this process */
+	enum mapistore_error		init_retval;
 } *backends = NULL;
 
 int					num_backends;
 
 
+/**
+   \details Set the hooks run around the operations of backends
+   flagged MAPISTORE_BACKEND_THREAD_SAFE. The caller uses them to let
+   other threads run while such a backend works.
+
+   \param leave hook run before the operation, returns whether the
+   caller gave anything up that the enter hook must take back
+   \param enter hook run after the operation
+ */
+_PUBLIC_ void mapistore_set_backend_call_hooks(bool (*leave)(void), void (*enter)(void))
+{
+	backend_call_leave = leave;
+	backend_call_enter = enter;
+}
+
+
+/**
+   \details Tell whether the registered backends may run their
+   operations concurrently
+
+   \param thread_safe pointer on the boolean set to true when at least
+   one backend is flagged MAPISTORE_BACKEND_THREAD_SAFE
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_INITIALIZED
+   when no backend was registered yet
+ */
+_PUBLIC_ enum mapistore_error mapistore_backend_thread_safe(bool *thread_safe)
+{
+	int	i;
+
+	MAPISTORE_RETVAL_IF(!thread_safe, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!num_backends, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	*thread_safe = false;
+	for (i = 0; i < num_backends; i++) {
+		if (backends[i].backend->backend.flags & MAPISTORE_BACKEND_THREAD_SAFE) {
+			*thread_safe = true;
+			break;
+		}
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+#if defined(HAVE_PTHREADS)
+static void mapistore_backend_call_locks_init(void)
+{
+	int	i;
+
+	for (i = 0; i < MAPISTORE_BACKEND_CALL_LOCKS; i++) {
+		pthread_mutex_init(&backend_call_locks[i], NULL);
+	}
+}
+
+static pthread_mutex_t *mapistore_backend_call_lock(const struct backend_context *bctx)
+{
+	pthread_once(&backend_call_locks_once, mapistore_backend_call_locks_init);
+	return &backend_call_locks[hash_pointer(bctx, 0) % MAPISTORE_BACKEND_CALL_LOCKS];
+}
+#endif
+
+/**
+   \details Run the leave hook before an operation of a thread safe
+   backend, then wait for the operations other threads run on the same
+   context. The context lock is taken after the hook released the
+   caller's lock, so a thread waiting for it never blocks the threads
+   coming back from the backend.
+ */
+static bool mapistore_backend_call_leave(const struct backend_context *bctx)
+{
+	if (!backend_call_leave || !(bctx->backend->backend.flags & MAPISTORE_BACKEND_THREAD_SAFE)) {
+		return false;
+	}
+
+	if (!backend_call_leave()) {
+		return false;
+	}
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_lock(mapistore_backend_call_lock(bctx));
+#endif
+
+	return true;
+}
+
+static void mapistore_backend_call_enter(const struct backend_context *bctx, bool released)
+{
+	if (!released) return;
+
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_unlock(mapistore_backend_call_lock(bctx));
+#endif
+	if (backend_call_enter) {
+		backend_call_enter();
+	}
+}
+
+
 /**
    \details Register mapistore backends
 
@@ -79,6 +209,8 @@ _PUBLIC_ enum mapistore_error mapistore_backend_register(const void *_backend)
 
 	backends[num_backends].backend = smb_xmemdup(backend, sizeof (*backend));
 	backends[num_backends].backend->backend.name = smb_xstrdup(backend->backend.name);
+	backends[num_backends].initialized = false;
+	backends[num_backends].init_retval = MAPISTORE_SUCCESS;
 
 	num_backends++;
 
@@ -251,22 +383,127 @@ _PUBLIC_ bool mapistore_backend_run_init(init_backend_fn *fns)
 }
 
 
+/**
+   \details Account the result of the init function of a backend
+ */
+static void mapistore_backend_init_done(struct mstore_backend *mb)
+{
+	mb->initialized = true;
+	if (mb->init_retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(1, "[!] MAPISTORE backend '%s' initialization failed", mb->backend->backend.name);
+	} else {
+		OC_DEBUG(3, "MAPISTORE backend '%s' loaded", mb->backend->backend.name);
+	}
+}
+
+
+/**
+   \details Run the init function of a backend, unless it already ran
+   in this process
+
+   A backend whose initialization failed is still used, as it was
+   before backends were initialized on demand.
+
+   \param mb pointer to the registered backend
+ */
+static void mapistore_backend_init_once(struct mstore_backend *mb)
+{
+	if (mb->initialized) return;
+
+	mb->init_retval = mb->backend->backend.init();
+	mapistore_backend_init_done(mb);
+}
+
+
+#if defined(HAVE_PTHREADS)
+static void *mapistore_backend_init_thread(void *data)
+{
+	struct mstore_backend	*mb = (struct mstore_backend *) data;
+
+	mb->init_retval = mb->backend->backend.init();
+
+	return NULL;
+}
+#endif
+
+
+/**
+   \details Run the init function of every backend which has not run
+   it yet
+
+   \param parallel whether the backends flagged
+   MAPISTORE_BACKEND_THREAD_SAFE are initialized in their own thread,
+   while the others are initialized in turn
+ */
+static void mapistore_backend_init_all(bool parallel)
+{
+	int		i;
+#if defined(HAVE_PTHREADS)
+	pthread_t	*threads = NULL;
+	bool		*started = NULL;
+
+	if (parallel && num_backends > 1) {
+		threads = talloc_array(NULL, pthread_t, num_backends);
+		started = talloc_zero_array(threads, bool, num_backends);
+		if (!threads || !started) {
+			talloc_free(threads);
+			threads = NULL;
+		}
+	}
+
+	for (i = 0; threads && i < num_backends; i++) {
+		if (backends[i].initialized || !(backends[i].backend->backend.flags & MAPISTORE_BACKEND_THREAD_SAFE)) {
+			continue;
+		}
+		started[i] = (pthread_create(&threads[i], NULL, mapistore_backend_init_thread, &backends[i]) == 0);
+	}
+#else
+	if (parallel) {
+		OC_DEBUG(3, "parallel backend initialization requires pthreads");
+	}
+#endif
+
+	for (i = 0; i < num_backends; i++) {
+#if defined(HAVE_PTHREADS)
+		if (threads && started[i]) continue;
+#endif
+		mapistore_backend_init_once(&backends[i]);
+	}
+
+#if defined(HAVE_PTHREADS)
+	for (i = 0; threads && i < num_backends; i++) {
+		if (!started[i]) continue;
+		pthread_join(threads[i], NULL);
+		mapistore_backend_init_done(&backends[i]);
+	}
+	talloc_free(threads);
+#endif
+}
+
+
 /**
    \details Initialize mapistore backends
 
+   The backend libraries are loaded and register themselves. Their
+   init function is run right away, unless lazy is set: it is then
+   run when the backend is first used, which is usually when the first
+   URI of its namespace is opened. In both cases, it is run once per
+   process.
+
    \param mem_ctx pointer to the memory context
    \param path pointer to folder where mapistore backends are
    installed
+   \param lazy whether the backends are initialized on first use
+   \param parallel whether thread safe backends are initialized
+   concurrently, when they are not initialized on first use
 
    \return MAPISTORE_SUCCESS on success, otherwise
    MAPISTORE_ERR_BACKEND_INIT
  */
-enum mapistore_error mapistore_backend_init(TALLOC_CTX *mem_ctx, const char *path)
+enum mapistore_error mapistore_backend_init(TALLOC_CTX *mem_ctx, const char *path, bool lazy, bool parallel)
 {
 	init_backend_fn			*ret;
 	bool				status;
-	int				retval;
-	int				i;
 
 	ret = mapistore_backend_load(mem_ctx, path);
 	status = mapistore_backend_run_init(ret);
@@ -277,15 +514,8 @@ enum mapistore_error mapistore_backend_init(TALLOC_CTX *mem_ctx, const char *pat
 		return MAPISTORE_ERR_BACKEND_INIT;
 	}
 
-	for (i = 0; i < num_backends; i++) {
-		if (backends[i].backend) {
-			retval = backends[i].backend->backend.init();
-			if (retval != MAPISTORE_SUCCESS) {
-				OC_DEBUG(1, "[!] MAPISTORE backend '%s' initialization failed", backends[i].backend->backend.name);
-			} else {
-				OC_DEBUG(3, "MAPISTORE backend '%s' loaded", backends[i].backend->backend.name);
-			}
-		}
+	if (!lazy) {
+		mapistore_backend_init_all(parallel);
 	}
 
 	return (status != true) ? MAPISTORE_SUCCESS : MAPISTORE_ERR_BACKEND_INIT;
@@ -305,12 +535,16 @@ enum mapistore_error mapistore_backend_list_contexts(const char *username, struc
 	enum mapistore_error		retval;
 	int				i;
 	struct mapistore_contexts_list	*contexts_list = NULL, *current_contexts_list;
+	struct timespec			start;
 
 	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!contexts_listP, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	for (i = 0; i < num_backends; i++) {
+		mapistore_backend_init_once(&backends[i]);
+		mapistore_backend_profile_start(&start);
 		retval = backends[i].backend->backend.list_contexts(username, ictx, mem_ctx, &current_contexts_list);
+		mapistore_backend_profile_end(backends[i].backend, MAPISTORE_BACKEND_OP_LIST_CONTEXTS, NULL, &start, retval);
 		if (retval != MAPISTORE_SUCCESS) {
 			return retval;
 		}
@@ -340,6 +574,7 @@ enum mapistore_error mapistore_backend_create_context(TALLOC_CTX *mem_ctx, struc
 	bool				found = false;
 	void				*backend_object = NULL;
 	int				i;
+	struct timespec			start;
 
 	OC_DEBUG(5, "namespace is %s and backend_uri is '%s'", namespace, uri);
 
@@ -349,7 +584,10 @@ enum mapistore_error mapistore_backend_create_context(TALLOC_CTX *mem_ctx, struc
 		if (backends[i].backend->backend.namespace && 
 		    !strcmp(namespace, backends[i].backend->backend.namespace)) {
 			found = true;
+			mapistore_backend_init_once(&backends[i]);
+			mapistore_backend_profile_start(&start);
 			retval = backends[i].backend->backend.create_context(context, conn_info, ictx, uri, &backend_object);
+			mapistore_backend_profile_end(backends[i].backend, MAPISTORE_BACKEND_OP_CREATE_CONTEXT, uri, &start, retval);
 			if (retval != MAPISTORE_SUCCESS) {
 				goto end;
 			}
@@ -366,7 +604,9 @@ enum mapistore_error mapistore_backend_create_context(TALLOC_CTX *mem_ctx, struc
 
 	context->backend_object = backend_object;
 	context->backend = backends[i].backend;
+	mapistore_backend_profile_start(&start);
 	retval = context->backend->context.get_root_folder(backend_object, context, fid, &context->root_folder_object);
+	mapistore_backend_profile_end(context->backend, MAPISTORE_BACKEND_OP_GET_ROOT_FOLDER, uri, &start, retval);
 	if (retval != MAPISTORE_SUCCESS) {
 		goto end;
 	}
@@ -388,9 +628,13 @@ enum mapistore_error mapistore_backend_create_root_folder(const char *username,
 {
 	enum mapistore_error		retval = MAPISTORE_ERR_NOT_FOUND;
 	int				i;
+	struct timespec			start;
 
 	for (i = 0; retval == MAPISTORE_ERR_NOT_FOUND && i < num_backends; i++) {
+		mapistore_backend_init_once(&backends[i]);
+		mapistore_backend_profile_start(&start);
 		retval = backends[i].backend->backend.create_root_folder(username, ctx_role, fid, name, mem_ctx, mapistore_urip);
+		mapistore_backend_profile_end(backends[i].backend, MAPISTORE_BACKEND_OP_CREATE_ROOT_FOLDER, NULL, &start, retval);
 	}
 
 	return retval;
@@ -438,53 +682,59 @@ _PUBLIC_ enum mapistore_error mapistore_backend_delete_context(struct backend_co
 /**
    \details find the context matching given context identifier
 
-   \param backend_list_ctx pointer to the backend context list
+   \param mstore_ctx pointer to the mapistore context
    \param context_id the context identifier to search
 
    \return Pointer to the mapistore_backend context on success, otherwise NULL
  */
-_PUBLIC_ struct backend_context *mapistore_backend_lookup(struct backend_context_list *backend_list_ctx,
+_PUBLIC_ struct backend_context *mapistore_backend_lookup(struct mapistore_context *mstore_ctx,
 							  uint32_t context_id)
 {
+	struct processing_context	*pctx;
 	struct backend_context_list	*el;
 
 	/* Sanity checks */
-	if (!backend_list_ctx) return NULL;
+	if (!mstore_ctx || !mstore_ctx->processing_ctx) return NULL;
 
-	for (el = backend_list_ctx; el; el = el->next) {
-		if (el->ctx && el->ctx->context_id == context_id) {
-			return el->ctx;
-		}
-	}
+	pctx = mstore_ctx->processing_ctx;
+	if (context_id >= pctx->contexts_size) return NULL;
 
-	return NULL;
+	el = pctx->contexts[context_id];
+
+	return el ? el->ctx : NULL;
 }
 
 /**
    \details find the context matching given uri string
 
-   \param backend_list_ctx pointer to the backend context list
+   \param mstore_ctx pointer to the mapistore context
    \param uri the uri string to search
 
    \return Pointer to the mapistore_backend context on success,
    otherwise NULL
  */
-_PUBLIC_ struct backend_context *mapistore_backend_lookup_by_uri(struct backend_context_list *backend_list_ctx,
+_PUBLIC_ struct backend_context *mapistore_backend_lookup_by_uri(struct mapistore_context *mstore_ctx,
 								 const char *uri)
 {
+	struct processing_context	*pctx;
 	struct backend_context_list	*el;
+	struct htable_iter		iter;
+	size_t				h;
 
 	/* sanity checks */
-	if (!backend_list_ctx) return NULL;
+	if (!mstore_ctx || !mstore_ctx->processing_ctx) return NULL;
 	if (!uri) return NULL;
 
-	for (el = backend_list_ctx; el; el = el->next) {
-		if (el->ctx && el->ctx->uri &&
-		    !strcmp(el->ctx->uri, uri)) {
+	pctx = mstore_ctx->processing_ctx;
+	if (!pctx->uri_ht.rehash) return NULL;
+
+	h = hash_string(uri);
+	for (el = htable_firstval(&pctx->uri_ht, &iter, h); el; el = htable_nextval(&pctx->uri_ht, &iter, h)) {
+		if (el->ctx && el->ctx->uri && !strcmp(el->ctx->uri, uri)) {
 			return el->ctx;
 		}
 	}
-	
+
 	return NULL;
 }
 
@@ -507,6 +757,7 @@ _PUBLIC_ struct backend_context *mapistore_backend_lookup_by_name(TALLOC_CTX *me
 
 	for (i = 0; i < num_backends; i++) {
 		if (backends[i].backend && !strcmp(backends[i].backend->backend.name, name)) {
+			mapistore_backend_init_once(&backends[i]);
 			context = talloc_zero(mem_ctx, struct backend_context);
 			context->backend = backends[i].backend;
 			context->ref_count = 0;
@@ -523,8 +774,11 @@ enum mapistore_error mapistore_backend_get_path(struct backend_context *bctx, TA
 {
 	enum mapistore_error	ret;
 	char			*bpath = NULL;
+	struct timespec		start;
 
+	mapistore_backend_profile_start(&start);
 	ret = bctx->backend->context.get_path(bctx->backend_object, mem_ctx, fmid, &bpath);
+	mapistore_backend_profile_end(bctx->backend, MAPISTORE_BACKEND_OP_GET_PATH, bctx->uri, &start, ret);
 
 	if (ret == MAPISTORE_SUCCESS) {
 		if (!bpath) {
@@ -543,59 +797,64 @@ enum mapistore_error mapistore_backend_get_path(struct backend_context *bctx, TA
 
 enum mapistore_error mapistore_backend_folder_open_folder(struct backend_context *bctx, void *folder, TALLOC_CTX *mem_ctx, uint64_t fid, void **child_folder)
 {
-	return bctx->backend->folder.open_folder(folder, mem_ctx, fid, child_folder);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_OPEN_FOLDER, bctx->backend->folder.open_folder(folder, mem_ctx, fid, child_folder));
 }
 
 enum mapistore_error mapistore_backend_folder_create_folder(struct backend_context *bctx, void *folder,
 					   TALLOC_CTX *mem_ctx, uint64_t fid, struct SRow *aRow, void **child_folder)
 {
-	return bctx->backend->folder.create_folder(folder, mem_ctx, fid, aRow, child_folder);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_CREATE_FOLDER, bctx->backend->folder.create_folder(folder, mem_ctx, fid, aRow, child_folder));
 }
 
 enum mapistore_error mapistore_backend_folder_delete(struct backend_context *bctx, void *folder)
 {
-	return bctx->backend->folder.delete(folder);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_DELETE, bctx->backend->folder.delete(folder));
 }
 
 enum mapistore_error mapistore_backend_folder_open_message(struct backend_context *bctx, void *folder,
 					  TALLOC_CTX *mem_ctx, uint64_t mid, bool read_write, void **messagep)
 {
-	return bctx->backend->folder.open_message(folder, mem_ctx, mid, read_write, messagep);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_OPEN_MESSAGE, bctx->backend->folder.open_message(folder, mem_ctx, mid, read_write, messagep));
 }
 
 enum mapistore_error mapistore_backend_folder_create_message(struct backend_context *bctx, void *folder, TALLOC_CTX *mem_ctx, uint64_t mid, uint8_t associated, void **messagep)
 {
-	return bctx->backend->folder.create_message(folder, mem_ctx, mid, associated, messagep);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_CREATE_MESSAGE, bctx->backend->folder.create_message(folder, mem_ctx, mid, associated, messagep));
 }
 
 enum mapistore_error mapistore_backend_folder_delete_message(struct backend_context *bctx, void *folder, uint64_t mid, uint8_t flags)
 {
-        return bctx->backend->folder.delete_message(folder, mid, flags);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGE, bctx->backend->folder.delete_message(folder, mid, flags));
 }
 
 enum mapistore_error mapistore_backend_folder_move_copy_messages(struct backend_context *bctx, void *target_folder, void *source_folder, TALLOC_CTX *mem_ctx, uint32_t mid_count, uint64_t *source_mids, uint64_t *target_mids, struct Binary_r **target_change_keys, struct Binary_r **target_predecessor_change_lists, uint8_t want_copy)
 {
-	return bctx->backend->folder.move_copy_messages(target_folder, source_folder, mem_ctx, mid_count, source_mids, target_mids, target_change_keys, target_predecessor_change_lists, want_copy);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_MOVE_COPY_MESSAGES, bctx->backend->folder.move_copy_messages(target_folder, source_folder, mem_ctx, mid_count, source_mids, target_mids, target_change_keys, target_predecessor_change_lists, want_copy));
 }
 
 enum mapistore_error mapistore_backend_folder_move_folder(struct backend_context *bctx, void *move_folder, void *target_folder, TALLOC_CTX *mem_ctx, const char *new_folder_name)
 {
-        return bctx->backend->folder.move_folder(move_folder, target_folder, mem_ctx, new_folder_name);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_MOVE_FOLDER, bctx->backend->folder.move_folder(move_folder, target_folder, mem_ctx, new_folder_name));
 }
 
 enum mapistore_error mapistore_backend_folder_copy_folder(struct backend_context *bctx, void *move_folder, void *target_folder, TALLOC_CTX *mem_ctx, bool recursive, const char *new_folder_name)
 {
-        return bctx->backend->folder.copy_folder(move_folder, target_folder, mem_ctx, recursive, new_folder_name);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_COPY_FOLDER, bctx->backend->folder.copy_folder(move_folder, target_folder, mem_ctx, recursive, new_folder_name));
 }
 
 enum mapistore_error mapistore_backend_folder_get_deleted_fmids(struct backend_context *bctx, void *folder, TALLOC_CTX *mem_ctx, enum mapistore_table_type table_type, uint64_t change_num, struct UI8Array_r **fmidsp, uint64_t *cnp)
 {
-        return bctx->backend->folder.get_deleted_fmids(folder, mem_ctx, table_type, change_num, fmidsp, cnp);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_GET_DELETED_FMIDS, bctx->backend->folder.get_deleted_fmids(folder, mem_ctx, table_type, change_num, fmidsp, cnp));
+}
+
+enum mapistore_error mapistore_backend_folder_get_changed_fmids(struct backend_context *bctx, void *folder, TALLOC_CTX *mem_ctx, enum mapistore_table_type table_type, uint64_t change_num, struct UI8Array_r **fmidsp)
+{
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_GET_CHANGED_FMIDS, bctx->backend->folder.get_changed_fmids(folder, mem_ctx, table_type, change_num, fmidsp));
 }
 
 enum mapistore_error mapistore_backend_folder_get_child_count(struct backend_context *bctx, void *folder, enum mapistore_table_type table_type, uint32_t *RowCount)
 {
-	return bctx->backend->folder.get_child_count(folder, table_type, RowCount);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_GET_CHILD_COUNT, bctx->backend->folder.get_child_count(folder, table_type, RowCount));
 }
 
 enum mapistore_error mapistore_backend_folder_get_child_fid_by_name(struct backend_context *bctx, void *folder, const char *name, uint64_t *fidp)
@@ -643,110 +902,139 @@ enum mapistore_error mapistore_backend_folder_get_child_fid_by_name(struct backe
 enum mapistore_error mapistore_backend_folder_open_table(struct backend_context *bctx, void *folder,
 							 TALLOC_CTX *mem_ctx, enum mapistore_table_type table_type, uint32_t handle_id, void **table, uint32_t *row_count)
 {
-        return bctx->backend->folder.open_table(folder, mem_ctx, table_type, handle_id, table, row_count);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_OPEN_TABLE, bctx->backend->folder.open_table(folder, mem_ctx, table_type, handle_id, table, row_count));
 }
 
 enum mapistore_error mapistore_backend_folder_modify_permissions(struct backend_context *bctx, void *folder,
 						uint8_t flags, uint16_t pcount, struct PermissionData *permissions)
 {
-        return bctx->backend->folder.modify_permissions(folder, flags, pcount, permissions);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_MODIFY_PERMISSIONS, bctx->backend->folder.modify_permissions(folder, flags, pcount, permissions));
 }
 
 enum mapistore_error mapistore_backend_folder_preload_message_bodies(struct backend_context *bctx, void *folder, enum mapistore_table_type table_type, const struct UI8Array_r *mids)
 {
-        return bctx->backend->folder.preload_message_bodies(folder, table_type, mids);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_PRELOAD_MESSAGE_BODIES, bctx->backend->folder.preload_message_bodies(folder, table_type, mids));
+}
+
+enum mapistore_error mapistore_backend_folder_set_read_flags(struct backend_context *bctx, void *folder, uint32_t mid_count, const uint64_t *mids, uint8_t flag)
+{
+	if (!bctx->backend->folder.set_read_flags) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_SET_READ_FLAGS, bctx->backend->folder.set_read_flags(folder, mid_count, mids, flag));
+}
+
+enum mapistore_error mapistore_backend_folder_delete_messages(struct backend_context *bctx, void *folder, uint32_t mid_count, const uint64_t *mids, uint8_t flags)
+{
+	if (!bctx->backend->folder.delete_messages) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGES, bctx->backend->folder.delete_messages(folder, mid_count, mids, flags));
 }
 
 enum mapistore_error mapistore_backend_message_get_message_data(struct backend_context *bctx, void *message, TALLOC_CTX *mem_ctx, struct mapistore_message **msg)
 {
-	return bctx->backend->message.get_message_data(message, mem_ctx, msg);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_GET_MESSAGE_DATA, bctx->backend->message.get_message_data(message, mem_ctx, msg));
 }
 
 enum mapistore_error mapistore_backend_message_modify_recipients(struct backend_context *bctx, void *message, struct SPropTagArray *columns, uint16_t count, struct mapistore_message_recipient *recipients)
 {
-	return bctx->backend->message.modify_recipients(message, columns, count, recipients);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_MODIFY_RECIPIENTS, bctx->backend->message.modify_recipients(message, columns, count, recipients));
 }
 
 enum mapistore_error mapistore_backend_message_set_read_flag(struct backend_context *bctx, void *message, uint8_t flag)
 {
-	return bctx->backend->message.set_read_flag(message, flag);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_SET_READ_FLAG, bctx->backend->message.set_read_flag(message, flag));
 }
 
 enum mapistore_error mapistore_backend_message_save(struct backend_context *bctx, void *message, TALLOC_CTX *mem_ctx)
 {
-	return bctx->backend->message.save(message, mem_ctx);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_SAVE, bctx->backend->message.save(message, mem_ctx));
 }
 
 enum mapistore_error mapistore_backend_message_submit(struct backend_context *bctx, void *message, enum SubmitFlags flags)
 {
-	return bctx->backend->message.submit(message, flags);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_SUBMIT, bctx->backend->message.submit(message, flags));
 }
 
 enum mapistore_error mapistore_backend_message_open_attachment(struct backend_context *bctx, void *message, TALLOC_CTX *mem_ctx, uint32_t aid, void **attachment)
 {
-        return bctx->backend->message.open_attachment(message, mem_ctx, aid, attachment);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_OPEN_ATTACHMENT, bctx->backend->message.open_attachment(message, mem_ctx, aid, attachment));
 }
 
 enum mapistore_error mapistore_backend_message_create_attachment(struct backend_context *bctx, void *message, TALLOC_CTX *mem_ctx, void **attachment, uint32_t *aid)
 {
-        return bctx->backend->message.create_attachment(message, mem_ctx, attachment, aid);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_CREATE_ATTACHMENT, bctx->backend->message.create_attachment(message, mem_ctx, attachment, aid));
 }
 
 enum mapistore_error mapistore_backend_message_get_attachment_table(struct backend_context *bctx, void *message, TALLOC_CTX *mem_ctx, void **table, uint32_t *row_count)
 {
-        return bctx->backend->message.get_attachment_table(message, mem_ctx, table, row_count);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_GET_ATTACHMENT_TABLE, bctx->backend->message.get_attachment_table(message, mem_ctx, table, row_count));
 }
 
 enum mapistore_error mapistore_backend_message_attachment_open_embedded_message(struct backend_context *bctx, void *attachment, TALLOC_CTX *mem_ctx, void **embedded_message, uint64_t *mid, struct mapistore_message **msg)
 {
-        return bctx->backend->message.open_embedded_message(attachment, mem_ctx, embedded_message, mid, msg);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_OPEN_EMBEDDED_MESSAGE, bctx->backend->message.open_embedded_message(attachment, mem_ctx, embedded_message, mid, msg));
 }
 
 enum mapistore_error mapistore_backend_message_attachment_create_embedded_message(struct backend_context *bctx, void *attachment, TALLOC_CTX *mem_ctx, void **embedded_message, struct mapistore_message **msg)
 {
-        return bctx->backend->message.create_embedded_message(attachment, mem_ctx, embedded_message, msg);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MESSAGE_CREATE_EMBEDDED_MESSAGE, bctx->backend->message.create_embedded_message(attachment, mem_ctx, embedded_message, msg));
 }
 
 enum mapistore_error mapistore_backend_table_get_available_properties(struct backend_context *bctx, void *table, TALLOC_CTX *mem_ctx, struct SPropTagArray **propertiesp)
 {
-        return bctx->backend->table.get_available_properties(table, mem_ctx, propertiesp);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_GET_AVAILABLE_PROPERTIES, bctx->backend->table.get_available_properties(table, mem_ctx, propertiesp));
 }
 
 enum mapistore_error mapistore_backend_table_set_columns(struct backend_context *bctx, void *table, uint16_t count, enum MAPITAGS *properties)
 {
-        return bctx->backend->table.set_columns(table, count, properties);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_SET_COLUMNS, bctx->backend->table.set_columns(table, count, properties));
 }
 
 enum mapistore_error mapistore_backend_table_set_restrictions(struct backend_context *bctx, void *table, struct mapi_SRestriction *restrictions, uint8_t *table_status)
 {
-        return bctx->backend->table.set_restrictions(table, restrictions, table_status);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_SET_RESTRICTIONS, bctx->backend->table.set_restrictions(table, restrictions, table_status));
 }
 
 enum mapistore_error mapistore_backend_table_set_sort_order(struct backend_context *bctx, void *table, struct SSortOrderSet *sort_order, uint8_t *table_status)
 {
-        return bctx->backend->table.set_sort_order(table, sort_order, table_status);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_SET_SORT_ORDER, bctx->backend->table.set_sort_order(table, sort_order, table_status));
 }
 
 enum mapistore_error mapistore_backend_table_get_row(struct backend_context *bctx, void *table, TALLOC_CTX *mem_ctx,
 						     enum mapistore_query_type query_type, uint32_t rowid,
 						     struct mapistore_property_data **data)
 {
-        return bctx->backend->table.get_row(table, mem_ctx, query_type, rowid, data);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_GET_ROW, bctx->backend->table.get_row(table, mem_ctx, query_type, rowid, data));
+}
+
+enum mapistore_error mapistore_backend_table_get_rows(struct backend_context *bctx, void *table, TALLOC_CTX *mem_ctx,
+						      enum mapistore_query_type query_type, uint32_t start, uint32_t count,
+						      struct mapistore_property_data ***rowsp, uint32_t *fetchedp)
+{
+	if (!bctx->backend->table.get_rows) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_GET_ROWS, bctx->backend->table.get_rows(table, mem_ctx, query_type, start, count, rowsp, fetchedp));
 }
 
 enum mapistore_error mapistore_backend_table_get_row_count(struct backend_context *bctx, void *table, enum mapistore_query_type query_type, uint32_t *row_countp)
 {
-        return bctx->backend->table.get_row_count(table, query_type, row_countp);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_GET_ROW_COUNT, bctx->backend->table.get_row_count(table, query_type, row_countp));
 }
 
 enum mapistore_error mapistore_backend_table_handle_destructor(struct backend_context *bctx, void *table, uint32_t handle_id)
 {
-        return bctx->backend->table.handle_destructor(table, handle_id);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_TABLE_HANDLE_DESTRUCTOR, bctx->backend->table.handle_destructor(table, handle_id));
 }
 
 enum mapistore_error mapistore_backend_properties_get_available_properties(struct backend_context *bctx, void *object, TALLOC_CTX *mem_ctx, struct SPropTagArray **propertiesp)
 {
-        return bctx->backend->properties.get_available_properties(object, mem_ctx, propertiesp);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_PROPERTIES_GET_AVAILABLE_PROPERTIES, bctx->backend->properties.get_available_properties(object, mem_ctx, propertiesp));
 }
 
 enum mapistore_error mapistore_backend_properties_get_properties(struct backend_context *bctx,
@@ -755,17 +1043,66 @@ enum mapistore_error mapistore_backend_properties_get_properties(struct backend_
 						*properties,
 						struct mapistore_property_data *data)
 {
-        return bctx->backend->properties.get_properties(object, mem_ctx, count, properties, data);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_PROPERTIES_GET_PROPERTIES, bctx->backend->properties.get_properties(object, mem_ctx, count, properties, data));
 }
 
 enum mapistore_error mapistore_backend_properties_set_properties(struct backend_context *bctx, void *object, struct SRow *aRow)
 {
-        return bctx->backend->properties.set_properties(object, aRow);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_PROPERTIES_SET_PROPERTIES, bctx->backend->properties.set_properties(object, aRow));
+}
+
+enum mapistore_error mapistore_backend_properties_open_property_stream(struct backend_context *bctx, void *object, TALLOC_CTX *mem_ctx,
+								       enum MAPITAGS proptag, enum mapistore_stream_mode mode,
+								       void **streamp, uint64_t *sizep)
+{
+	if (!bctx->backend->properties.open_property_stream) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_PROPERTIES_OPEN_PROPERTY_STREAM, bctx->backend->properties.open_property_stream(object, mem_ctx, proptag, mode, streamp, sizep));
+}
+
+enum mapistore_error mapistore_backend_properties_copy_object(struct backend_context *bctx, void *source_object, void *target_object,
+							      struct SPropTagArray *excluded_tags, bool deep_copy)
+{
+	if (!bctx->backend->properties.copy_object) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_PROPERTIES_COPY_OBJECT, bctx->backend->properties.copy_object(source_object, target_object, excluded_tags, deep_copy));
+}
+
+enum mapistore_error mapistore_backend_stream_read(struct backend_context *bctx, void *stream, TALLOC_CTX *mem_ctx,
+						   uint64_t offset, uint32_t length, DATA_BLOB *data)
+{
+	if (!bctx->backend->stream.read) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_STREAM_READ, bctx->backend->stream.read(stream, mem_ctx, offset, length, data));
+}
+
+enum mapistore_error mapistore_backend_stream_write(struct backend_context *bctx, void *stream, uint64_t offset, DATA_BLOB data)
+{
+	if (!bctx->backend->stream.write) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_STREAM_WRITE, bctx->backend->stream.write(stream, offset, data));
+}
+
+enum mapistore_error mapistore_backend_stream_commit(struct backend_context *bctx, void *stream, uint64_t size)
+{
+	if (!bctx->backend->stream.commit) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_STREAM_COMMIT, bctx->backend->stream.commit(stream, size));
 }
 
 enum mapistore_error mapistore_backend_manager_generate_uri(struct backend_context *bctx, TALLOC_CTX *mem_ctx, 
 					   const char *username, const char *folder, 
 					   const char *message, const char *root_uri, char **uri)
 {
-	return bctx->backend->manager.generate_uri(mem_ctx, username, folder, message, root_uri, uri);
+	MAPISTORE_BACKEND_RETURN(bctx, MAPISTORE_BACKEND_OP_MANAGER_GENERATE_URI, bctx->backend->manager.generate_uri(mem_ctx, username, folder, message, root_uri, uri));
 }
@@ -158,6 +158,16 @@ static enum mapistore_error mapistore_op_defaults_get_deleted_fmids(void *folder
 	return MAPISTORE_ERR_NOT_IMPLEMENTED;
 }
 
+static enum mapistore_error mapistore_op_defaults_get_changed_fmids(void *folder_object,
+								    TALLOC_CTX *mem_ctx,
+								    enum mapistore_table_type table_type,
+								    uint64_t change_num,
+								    struct UI8Array_r **fmidsp)
+{
+	OC_DEBUG(3, "MAPISTORE defaults - MAPISTORE_ERR_NOT_IMPLEMENTED");
+	return MAPISTORE_ERR_NOT_IMPLEMENTED;
+}
+
 static enum mapistore_error mapistore_op_defaults_get_child_count(void *folder_object,
 								  enum mapistore_table_type table_type,
 								  uint32_t *RowCount)
@@ -300,6 +310,17 @@ static enum mapistore_error mapistore_op_defaults_get_row(void *table_object,
 	return MAPISTORE_ERR_NOT_IMPLEMENTED;
 }
 
+static enum mapistore_error mapistore_op_defaults_get_rows(void *table_object,
+							   TALLOC_CTX *mem_ctx,
+							   enum mapistore_query_type query_type,
+							   uint32_t start, uint32_t count,
+							   struct mapistore_property_data ***rowsp,
+							   uint32_t *fetchedp)
+{
+	OC_DEBUG(3, "MAPISTORE defaults - MAPISTORE_ERR_NOT_IMPLEMENTED");
+	return MAPISTORE_ERR_NOT_IMPLEMENTED;
+}
+
 static enum mapistore_error mapistore_op_defaults_get_row_count(void *table_object,
 								enum mapistore_query_type query_type,
 								uint32_t *row_countp)
@@ -370,6 +391,7 @@ extern enum mapistore_error mapistore_backend_init_defaults(struct mapistore_bac
 	backend->folder.delete_message = mapistore_op_defaults_delete_message;
 	backend->folder.move_copy_messages = mapistore_op_defaults_move_copy_messages;
 	backend->folder.get_deleted_fmids = mapistore_op_defaults_get_deleted_fmids;
+	backend->folder.get_changed_fmids = mapistore_op_defaults_get_changed_fmids;
 	backend->folder.get_child_count = mapistore_op_defaults_get_child_count;
 	backend->folder.open_table = mapistore_op_defaults_open_table;
 	backend->folder.modify_permissions = mapistore_op_defaults_modify_permissions;
@@ -391,6 +413,7 @@ extern enum mapistore_error mapistore_backend_init_defaults(struct mapistore_bac
 	backend->table.set_restrictions = mapistore_op_defaults_set_restrictions;
 	backend->table.set_sort_order = mapistore_op_defaults_set_sort_order;
 	backend->table.get_row = mapistore_op_defaults_get_row;
+	backend->table.get_rows = mapistore_op_defaults_get_rows;
 	backend->table.get_row_count = mapistore_op_defaults_get_row_count;
 	backend->table.handle_destructor = mapistore_op_defaults_handle_destructor;
 
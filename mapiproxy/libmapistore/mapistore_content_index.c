@@ -0,0 +1,1031 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_content_index.c
+
+   \brief Trigram index of the text properties of messages
+
+   The subject, body, sender and recipients of the messages of a folder
+   are split in trigrams stored in a TDB file of the mailbox owner's
+   mapistore directory. Each trigram maps to the sorted list of the
+   messages containing it, so substring, prefix and full string content
+   restrictions can be answered with the intersection of the lists of
+   the trigrams of the searched string instead of reading every message.
+
+   Answers are candidates: the caller still evaluates the restriction on
+   them. Messages whose text could not be read entirely are kept in a
+   per-folder list of messages which are always candidates.
+
+   Folders are only maintained once they were built: emsmdbp adds the
+   messages it saves and removes the ones it deletes or moves.
+
+   Records are keyed by a type byte followed by big-endian identifiers:
+   - F fid: the folder is indexed
+   - U fid: messages always returned as candidates
+   - P fid term: messages containing a trigram in a field
+   - D fid mid: the terms of a message, to remove it
+ */
+
+#include <string.h>
+#include <ctype.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+#include "libmapi/libmapi_private.h"
+
+#include <tdb.h>
+
+#define	MAPISTORE_CONTENT_INDEX_VERSION		1
+#define	MAPISTORE_CONTENT_INDEX_KEY_MAX		17
+
+#define	MAPISTORE_CONTENT_INDEX_FOLDER		'F'
+#define	MAPISTORE_CONTENT_INDEX_UNKNOWN		'U'
+#define	MAPISTORE_CONTENT_INDEX_POSTING		'P'
+#define	MAPISTORE_CONTENT_INDEX_DOCUMENT	'D'
+
+static bool content_index_enabled = false;
+
+/**
+   Text properties and the index field they are stored in. Properties
+   sharing a field are searched in the trigrams of all of them.
+ */
+static const struct {
+	enum MAPITAGS	proptag;
+	uint8_t		field;
+	bool		indexed;
+} mapistore_content_index_fields[] = {
+	{ PidTagSubject,			'S', true },
+	{ PidTagNormalizedSubject,		'S', false },
+	{ PidTagBody,				'B', true },
+	{ PidTagSenderName,			'F', true },
+	{ PidTagSenderEmailAddress,		'F', true },
+	{ PidTagSentRepresentingName,		'F', true },
+	{ PidTagSentRepresentingEmailAddress,	'F', true },
+	{ PidTagDisplayTo,			'R', true },
+	{ PidTagDisplayCc,			'R', true },
+	{ PidTagDisplayBcc,			'R', true }
+};
+
+#define	MAPISTORE_CONTENT_INDEX_FIELDS	(sizeof (mapistore_content_index_fields) / sizeof (mapistore_content_index_fields[0]))
+
+/**
+   \details Enable or disable the content index. When disabled, queries
+   are not answered and changes are not recorded.
+
+   \param enabled whether the content index is used
+ */
+_PUBLIC_ void mapistore_set_content_index(bool enabled)
+{
+	content_index_enabled = enabled;
+}
+
+/**
+   \details Return the text properties emsmdbp reads from the messages
+   to index them
+
+   \param mem_ctx pointer to the memory context
+   \param proptagsp pointer to the returned property tag array
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_content_index_get_proptags(TALLOC_CTX *mem_ctx, struct SPropTagArray **proptagsp)
+{
+	struct SPropTagArray	*proptags;
+	uint32_t		i;
+
+	MAPISTORE_RETVAL_IF(!proptagsp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	proptags = talloc_zero(mem_ctx, struct SPropTagArray);
+	MAPISTORE_RETVAL_IF(!proptags, MAPISTORE_ERR_NO_MEMORY, NULL);
+	proptags->aulPropTag = talloc_array(proptags, enum MAPITAGS, MAPISTORE_CONTENT_INDEX_FIELDS);
+	MAPISTORE_RETVAL_IF(!proptags->aulPropTag, MAPISTORE_ERR_NO_MEMORY, proptags);
+
+	for (i = 0; i < MAPISTORE_CONTENT_INDEX_FIELDS; i++) {
+		if (mapistore_content_index_fields[i].indexed) {
+			proptags->aulPropTag[proptags->cValues++] = mapistore_content_index_fields[i].proptag;
+		}
+	}
+	*proptagsp = proptags;
+
+	return MAPISTORE_SUCCESS;
+}
+
+static uint8_t mapistore_content_index_field(enum MAPITAGS proptag)
+{
+	uint32_t	i;
+
+	for (i = 0; i < MAPISTORE_CONTENT_INDEX_FIELDS; i++) {
+		if ((mapistore_content_index_fields[i].proptag >> 16) == (proptag >> 16)) {
+			return mapistore_content_index_fields[i].field;
+		}
+	}
+
+	return 0;
+}
+
+static struct tdb_context *mapistore_content_index_open(TALLOC_CTX *mem_ctx, const char *username, int open_flags)
+{
+	struct tdb_context	*tdb;
+	char			*dbpath;
+
+	if (open_flags & O_CREAT) {
+		dbpath = talloc_asprintf(mem_ctx, "%s/%s", mapistore_get_mapping_path(), username);
+		if (!dbpath) return NULL;
+		mkdir(dbpath, 0700);
+		talloc_free(dbpath);
+	}
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/%s/" MAPISTORE_DB_CONTENT_INDEX,
+				 mapistore_get_mapping_path(), username);
+	if (!dbpath) return NULL;
+
+	tdb = tdb_open(dbpath, 0, 0, open_flags, 0600);
+	if (!tdb && (open_flags & O_CREAT)) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
+	}
+	talloc_free(dbpath);
+
+	return tdb;
+}
+
+static void mapistore_content_index_put_id(uint8_t *p, uint64_t id)
+{
+	int	i;
+
+	for (i = 7; i >= 0; i--) {
+		p[i] = id & 0xff;
+		id >>= 8;
+	}
+}
+
+/**
+   \details Build the key of a record, suffix is the term of posting
+   records and the message identifier of document records
+ */
+static TDB_DATA mapistore_content_index_key(uint8_t *buffer, uint8_t type, uint64_t fid, uint32_t term, uint64_t mid)
+{
+	TDB_DATA	key;
+
+	buffer[0] = type;
+	mapistore_content_index_put_id(buffer + 1, fid);
+	key.dptr = buffer;
+	key.dsize = 9;
+
+	if (type == MAPISTORE_CONTENT_INDEX_POSTING) {
+		buffer[9] = (term >> 24) & 0xff;
+		buffer[10] = (term >> 16) & 0xff;
+		buffer[11] = (term >> 8) & 0xff;
+		buffer[12] = term & 0xff;
+		key.dsize = 13;
+	} else if (type == MAPISTORE_CONTENT_INDEX_DOCUMENT) {
+		mapistore_content_index_put_id(buffer + 9, mid);
+		key.dsize = 17;
+	}
+
+	return key;
+}
+
+/**
+   \details Fetch a sorted list of message identifiers, a missing record
+   is an empty list
+ */
+static enum mapistore_error mapistore_content_index_list_fetch(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, TDB_DATA key,
+							       uint64_t **midsp, uint32_t *countp)
+{
+	struct ndr_pull		*ndr;
+	TDB_DATA		data;
+	DATA_BLOB		blob;
+	uint64_t		*mids;
+	uint32_t		count, i;
+
+	*midsp = NULL;
+	*countp = 0;
+
+	data = tdb_fetch(tdb, key);
+	if (!data.dptr) return MAPISTORE_SUCCESS;
+
+	blob.data = data.dptr;
+	blob.length = data.dsize;
+	ndr = ndr_pull_init_blob(&blob, mem_ctx);
+	if (!ndr) {
+		free(data.dptr);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	if (ndr_pull_uint32(ndr, NDR_SCALARS, &count) != NDR_ERR_SUCCESS || count > data.dsize / 8) {
+		goto corrupted;
+	}
+	mids = talloc_array(mem_ctx, uint64_t, count ? count : 1);
+	if (!mids) {
+		talloc_free(ndr);
+		free(data.dptr);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	for (i = 0; i < count; i++) {
+		if (ndr_pull_hyper(ndr, NDR_SCALARS, &mids[i]) != NDR_ERR_SUCCESS) {
+			talloc_free(mids);
+			goto corrupted;
+		}
+	}
+	talloc_free(ndr);
+	free(data.dptr);
+
+	*midsp = mids;
+	*countp = count;
+
+	return MAPISTORE_SUCCESS;
+
+corrupted:
+	talloc_free(ndr);
+	free(data.dptr);
+	return MAPISTORE_ERR_CORRUPTED;
+}
+
+static enum mapistore_error mapistore_content_index_list_store(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, TDB_DATA key,
+							       const uint64_t *mids, uint32_t count)
+{
+	struct ndr_push		*ndr;
+	TDB_DATA		data;
+	uint32_t		i;
+	int			ret;
+
+	if (!count) {
+		tdb_delete(tdb, key);
+		return MAPISTORE_SUCCESS;
+	}
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+	ndr_push_uint32(ndr, NDR_SCALARS, count);
+	for (i = 0; i < count; i++) {
+		ndr_push_hyper(ndr, NDR_SCALARS, mids[i]);
+	}
+
+	data.dptr = ndr->data;
+	data.dsize = ndr->offset;
+	ret = tdb_store(tdb, key, data, TDB_REPLACE);
+	talloc_free(ndr);
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERR_DATABASE_OPS, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Position of a message identifier in a sorted list, or of the
+   place it would be inserted at
+ */
+static uint32_t mapistore_content_index_list_search(const uint64_t *mids, uint32_t count, uint64_t mid, bool *found)
+{
+	uint32_t	low = 0, high = count, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (mids[middle] < mid) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	*found = (low < count && mids[low] == mid);
+
+	return low;
+}
+
+/**
+   \details Add or remove a message identifier from the list stored in a
+   record
+ */
+static enum mapistore_error mapistore_content_index_list_update(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, TDB_DATA key,
+								uint64_t mid, bool add)
+{
+	enum mapistore_error	ret;
+	uint64_t		*mids;
+	uint32_t		count, pos;
+	bool			found;
+
+	ret = mapistore_content_index_list_fetch(mem_ctx, tdb, key, &mids, &count);
+	MAPISTORE_RETVAL_IF(ret, ret, NULL);
+
+	pos = mapistore_content_index_list_search(mids, count, mid, &found);
+	if (found == add) {
+		talloc_free(mids);
+		return MAPISTORE_SUCCESS;
+	}
+
+	if (add) {
+		mids = talloc_realloc(mem_ctx, mids, uint64_t, count + 1);
+		MAPISTORE_RETVAL_IF(!mids, MAPISTORE_ERR_NO_MEMORY, NULL);
+		memmove(mids + pos + 1, mids + pos, (count - pos) * sizeof (uint64_t));
+		mids[pos] = mid;
+		count++;
+	} else {
+		memmove(mids + pos, mids + pos + 1, (count - pos - 1) * sizeof (uint64_t));
+		count--;
+	}
+
+	ret = mapistore_content_index_list_store(mem_ctx, tdb, key, mids, count);
+	talloc_free(mids);
+
+	return ret;
+}
+
+static int mapistore_content_index_term_cmp(const void *a, const void *b)
+{
+	uint32_t	ta = *(const uint32_t *) a;
+	uint32_t	tb = *(const uint32_t *) b;
+
+	return (ta > tb) - (ta < tb);
+}
+
+/**
+   \details Append the distinct trigrams of a string to a term array.
+   Strings are folded the way content restrictions ignoring case are, so
+   the trigrams of a case-sensitive search are found too.
+ */
+static enum mapistore_error mapistore_content_index_terms(TALLOC_CTX *mem_ctx, uint8_t field, const char *text, size_t len,
+							  uint32_t **termsp, uint32_t *countp)
+{
+	uint32_t	*terms;
+	uint32_t	count, i, kept;
+	size_t		n;
+
+	if (len < 3) return MAPISTORE_SUCCESS;
+
+	count = *countp;
+	terms = talloc_realloc(mem_ctx, *termsp, uint32_t, count + len - 2);
+	MAPISTORE_RETVAL_IF(!terms, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (n = 0; n + 3 <= len; n++) {
+		terms[count++] = ((uint32_t) field << 24)
+			| ((uint32_t) tolower((unsigned char) text[n]) << 16)
+			| ((uint32_t) tolower((unsigned char) text[n + 1]) << 8)
+			| (uint32_t) tolower((unsigned char) text[n + 2]);
+	}
+
+	qsort(terms, count, sizeof (uint32_t), mapistore_content_index_term_cmp);
+	for (i = 0, kept = 0; i < count; i++) {
+		if (!kept || terms[kept - 1] != terms[i]) {
+			terms[kept++] = terms[i];
+		}
+	}
+
+	*termsp = terms;
+	*countp = kept;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Remove a message from the posting lists of its terms and
+   from the list of partially indexed messages
+ */
+static enum mapistore_error mapistore_content_index_doc_remove(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, uint64_t fid, uint64_t mid)
+{
+	uint8_t			buffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	uint8_t			pbuffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	enum mapistore_error	ret;
+	struct ndr_pull		*ndr;
+	TDB_DATA		key, data;
+	DATA_BLOB		blob;
+	uint32_t		version, count, term, i;
+
+	ret = mapistore_content_index_list_update(mem_ctx, tdb,
+						  mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_UNKNOWN, fid, 0, 0),
+						  mid, false);
+	MAPISTORE_RETVAL_IF(ret, ret, NULL);
+
+	key = mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_DOCUMENT, fid, 0, mid);
+	data = tdb_fetch(tdb, key);
+	if (!data.dptr) return MAPISTORE_SUCCESS;
+
+	blob.data = data.dptr;
+	blob.length = data.dsize;
+	ndr = ndr_pull_init_blob(&blob, mem_ctx);
+	if (!ndr) {
+		free(data.dptr);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	ret = MAPISTORE_SUCCESS;
+	if (ndr_pull_uint32(ndr, NDR_SCALARS, &version) != NDR_ERR_SUCCESS
+	    || version != MAPISTORE_CONTENT_INDEX_VERSION
+	    || ndr_pull_uint32(ndr, NDR_SCALARS, &count) != NDR_ERR_SUCCESS) {
+		ret = MAPISTORE_ERR_CORRUPTED;
+		count = 0;
+	}
+	for (i = 0; i < count && ret == MAPISTORE_SUCCESS; i++) {
+		if (ndr_pull_uint32(ndr, NDR_SCALARS, &term) != NDR_ERR_SUCCESS) {
+			ret = MAPISTORE_ERR_CORRUPTED;
+			break;
+		}
+		ret = mapistore_content_index_list_update(mem_ctx, tdb,
+							  mapistore_content_index_key(pbuffer, MAPISTORE_CONTENT_INDEX_POSTING, fid, term, 0),
+							  mid, false);
+	}
+	talloc_free(ndr);
+	free(data.dptr);
+
+	tdb_delete(tdb, key);
+
+	return ret;
+}
+
+/**
+   \details Tell whether the messages of a folder are indexed
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+
+   \return true if the folder is indexed, otherwise false
+ */
+_PUBLIC_ bool mapistore_content_index_folder_exists(struct mapistore_context *mstore_ctx, const char *username, uint64_t fid)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	uint8_t			buffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	bool			exists;
+
+	if (!mstore_ctx || !username || !content_index_enabled) return false;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return false;
+
+	tdb = mapistore_content_index_open(mem_ctx, username, O_RDONLY);
+	if (!tdb) {
+		talloc_free(mem_ctx);
+		return false;
+	}
+
+	exists = (tdb_exists(tdb, mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_FOLDER, fid, 0, 0)) != 0);
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return exists;
+}
+
+struct mapistore_content_index_drop_state {
+	uint8_t		prefix[9];
+	bool		failed;
+};
+
+static int mapistore_content_index_drop_record(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct mapistore_content_index_drop_state	*state = private_data;
+
+	if (key.dsize < 9 || memcmp(key.dptr + 1, state->prefix + 1, 8)) return 0;
+
+	if (tdb_delete(tdb, key) != 0) {
+		state->failed = true;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+   \details Drop the records of a folder and optionally mark it as
+   indexed, with no message, so it is filled by the caller
+ */
+static enum mapistore_error mapistore_content_index_folder_drop(const char *username, uint64_t fid, bool reset)
+{
+	TALLOC_CTX					*mem_ctx;
+	struct tdb_context				*tdb;
+	struct mapistore_content_index_drop_state	state;
+	uint8_t						buffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	TDB_DATA					data;
+	uint8_t						version = MAPISTORE_CONTENT_INDEX_VERSION;
+	enum mapistore_error				ret = MAPISTORE_SUCCESS;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_content_index_open(mem_ctx, username, reset ? O_RDWR|O_CREAT : O_RDWR);
+	if (!tdb) {
+		talloc_free(mem_ctx);
+		return reset ? MAPISTORE_ERR_DATABASE_INIT : MAPISTORE_SUCCESS;
+	}
+
+	if (tdb_transaction_start(tdb) != 0) {
+		tdb_close(tdb);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	memset(&state, 0, sizeof (state));
+	mapistore_content_index_put_id(state.prefix + 1, fid);
+	tdb_traverse(tdb, mapistore_content_index_drop_record, &state);
+	if (state.failed) {
+		ret = MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	if (ret == MAPISTORE_SUCCESS && reset) {
+		data.dptr = &version;
+		data.dsize = sizeof (version);
+		if (tdb_store(tdb, mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_FOLDER, fid, 0, 0), data, TDB_REPLACE) != 0) {
+			ret = MAPISTORE_ERR_DATABASE_OPS;
+		}
+	}
+
+	if (ret == MAPISTORE_SUCCESS) {
+		if (tdb_transaction_commit(tdb) != 0) {
+			ret = MAPISTORE_ERR_DATABASE_OPS;
+		}
+	} else {
+		tdb_transaction_cancel(tdb);
+	}
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Start indexing a folder: drop what was recorded for it and
+   mark it as indexed. The caller then adds each of its messages.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_AVAILABLE if
+   the content index is disabled, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_content_index_folder_reset(struct mapistore_context *mstore_ctx, const char *username, uint64_t fid)
+{
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!content_index_enabled, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	return mapistore_content_index_folder_drop(username, fid, true);
+}
+
+/**
+   \details Drop the index of a folder, which is built again by the next
+   query needing it
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_content_index_folder_invalidate(struct mapistore_context *mstore_ctx, const char *username, uint64_t fid)
+{
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	return mapistore_content_index_folder_drop(username, fid, false);
+}
+
+/**
+   \details Index the text properties of a message, replacing what was
+   recorded for it. Folders which are not indexed are left untouched.
+
+   Texts are indexed up to MAPISTORE_CONTENT_INDEX_TEXT_MAX bytes;
+   messages with longer texts, or flagged as partial because some of
+   their properties could not be read, are always returned as
+   candidates.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+   \param mid the message identifier
+   \param count number of properties
+   \param proptags array of text property tags
+   \param texts array of property values, NULL entries are skipped
+   \param partial whether some properties of the message are missing
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_content_index_add(struct mapistore_context *mstore_ctx, const char *username,
+							  uint64_t fid, uint64_t mid, uint32_t count,
+							  const enum MAPITAGS *proptags, const char * const *texts, bool partial)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	struct ndr_push		*ndr;
+	uint8_t			buffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	TDB_DATA		data;
+	enum mapistore_error	ret;
+	uint32_t		*terms = NULL;
+	uint32_t		term_count = 0, i;
+	uint8_t			field;
+	size_t			len;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && (!proptags || !texts), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!content_index_enabled, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (i = 0; i < count; i++) {
+		field = mapistore_content_index_field(proptags[i]);
+		if (!field || !texts[i]) continue;
+		len = strlen(texts[i]);
+		if (len > MAPISTORE_CONTENT_INDEX_TEXT_MAX) {
+			len = MAPISTORE_CONTENT_INDEX_TEXT_MAX;
+			partial = true;
+		}
+		ret = mapistore_content_index_terms(mem_ctx, field, texts[i], len, &terms, &term_count);
+		MAPISTORE_RETVAL_IF(ret, ret, mem_ctx);
+	}
+	if (!count) {
+		partial = true;
+	}
+
+	tdb = mapistore_content_index_open(mem_ctx, username, O_RDWR);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_SUCCESS, mem_ctx);
+
+	if (tdb_transaction_start(tdb) != 0) {
+		tdb_close(tdb);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	if (!tdb_exists(tdb, mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_FOLDER, fid, 0, 0))) {
+		ret = MAPISTORE_SUCCESS;
+		goto cancel;
+	}
+
+	ret = mapistore_content_index_doc_remove(mem_ctx, tdb, fid, mid);
+	if (ret) goto cancel;
+
+	for (i = 0; i < term_count; i++) {
+		ret = mapistore_content_index_list_update(mem_ctx, tdb,
+							  mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_POSTING, fid, terms[i], 0),
+							  mid, true);
+		if (ret) goto cancel;
+	}
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	if (!ndr) {
+		ret = MAPISTORE_ERR_NO_MEMORY;
+		goto cancel;
+	}
+	ndr_push_uint32(ndr, NDR_SCALARS, MAPISTORE_CONTENT_INDEX_VERSION);
+	ndr_push_uint32(ndr, NDR_SCALARS, term_count);
+	for (i = 0; i < term_count; i++) {
+		ndr_push_uint32(ndr, NDR_SCALARS, terms[i]);
+	}
+	data.dptr = ndr->data;
+	data.dsize = ndr->offset;
+	if (tdb_store(tdb, mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_DOCUMENT, fid, 0, mid), data, TDB_REPLACE) != 0) {
+		ret = MAPISTORE_ERR_DATABASE_OPS;
+		goto cancel;
+	}
+
+	if (partial) {
+		ret = mapistore_content_index_list_update(mem_ctx, tdb,
+							  mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_UNKNOWN, fid, 0, 0),
+							  mid, true);
+		if (ret) goto cancel;
+	}
+
+	if (tdb_transaction_commit(tdb) != 0) {
+		ret = MAPISTORE_ERR_DATABASE_OPS;
+	}
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+
+cancel:
+	tdb_transaction_cancel(tdb);
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Remove deleted or moved out messages from the index of their
+   folder
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+   \param count number of message identifiers
+   \param mids array of message identifiers
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_content_index_del(struct mapistore_context *mstore_ctx, const char *username,
+							  uint64_t fid, uint32_t count, const uint64_t *mids)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	enum mapistore_error	ret = MAPISTORE_SUCCESS;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!count || !content_index_enabled, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_content_index_open(mem_ctx, username, O_RDWR);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_SUCCESS, mem_ctx);
+
+	if (tdb_transaction_start(tdb) != 0) {
+		tdb_close(tdb);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	for (i = 0; i < count && ret == MAPISTORE_SUCCESS; i++) {
+		ret = mapistore_content_index_doc_remove(mem_ctx, tdb, fid, mids[i]);
+	}
+
+	if (ret == MAPISTORE_SUCCESS) {
+		if (tdb_transaction_commit(tdb) != 0) {
+			ret = MAPISTORE_ERR_DATABASE_OPS;
+		}
+	} else {
+		tdb_transaction_cancel(tdb);
+	}
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Reduce a sorted list of message identifiers to the ones
+   also present in b
+ */
+static void mapistore_content_index_intersect(uint64_t *a, uint32_t *a_count, const uint64_t *b, uint32_t b_count)
+{
+	uint32_t	i = 0, j = 0, kept = 0;
+
+	while (i < *a_count && j < b_count) {
+		if (a[i] < b[j]) {
+			i++;
+		} else if (a[i] > b[j]) {
+			j++;
+		} else {
+			a[kept++] = a[i++];
+			j++;
+		}
+	}
+	*a_count = kept;
+}
+
+/**
+   \details Merge two sorted lists of message identifiers
+ */
+static uint64_t *mapistore_content_index_union(TALLOC_CTX *mem_ctx, const uint64_t *a, uint32_t a_count,
+					       const uint64_t *b, uint32_t b_count, uint32_t *countp)
+{
+	uint64_t	*mids;
+	uint32_t	i = 0, j = 0, count = 0;
+
+	mids = talloc_array(mem_ctx, uint64_t, a_count + b_count + 1);
+	if (!mids) return NULL;
+
+	while (i < a_count || j < b_count) {
+		if (j == b_count || (i < a_count && a[i] < b[j])) {
+			mids[count++] = a[i++];
+		} else if (i == a_count || b[j] < a[i]) {
+			mids[count++] = b[j++];
+		} else {
+			mids[count++] = a[i++];
+			j++;
+		}
+	}
+	*countp = count;
+
+	return mids;
+}
+
+/**
+   \details Candidates of a content restriction: the messages holding
+   every trigram of the searched string in the field of the property
+ */
+static enum mapistore_error mapistore_content_index_plan_content(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, uint64_t fid,
+								 const struct mapi_SContentRestriction *res,
+								 uint64_t **midsp, uint32_t *countp)
+{
+	uint8_t			buffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	enum mapistore_error	ret;
+	const char		*needle;
+	uint32_t		*terms = NULL;
+	uint32_t		term_count = 0, i, count, posting_count;
+	uint64_t		*mids, *posting;
+	uint8_t			field;
+
+	/* The stored trigrams do not tell about accents or loose matches */
+	if (res->fuzzy & (FL_IGNORENONSPACE|FL_LOOSE)) return MAPISTORE_ERR_NOT_AVAILABLE;
+	switch (res->fuzzy & 0xFFFF) {
+	case FL_FULLSTRING:
+	case FL_SUBSTRING:
+	case FL_PREFIX:
+		break;
+	default:
+		return MAPISTORE_ERR_NOT_AVAILABLE;
+	}
+
+	switch (res->lpProp.ulPropTag & 0xFFFF) {
+	case PT_UNICODE:
+		needle = res->lpProp.value.lpszW;
+		break;
+	case PT_STRING8:
+		needle = res->lpProp.value.lpszA;
+		break;
+	default:
+		return MAPISTORE_ERR_NOT_AVAILABLE;
+	}
+
+	field = mapistore_content_index_field(res->ulPropTag);
+	if (!field || !needle || strlen(needle) < 3) return MAPISTORE_ERR_NOT_AVAILABLE;
+
+	/* Only tell whether the restriction can be answered */
+	if (!tdb) {
+		*midsp = NULL;
+		*countp = 0;
+		return MAPISTORE_SUCCESS;
+	}
+
+	ret = mapistore_content_index_terms(mem_ctx, field, needle, strlen(needle), &terms, &term_count);
+	MAPISTORE_RETVAL_IF(ret, ret, NULL);
+
+	mids = NULL;
+	count = 0;
+	for (i = 0; i < term_count; i++) {
+		ret = mapistore_content_index_list_fetch(mem_ctx, tdb,
+							 mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_POSTING, fid, terms[i], 0),
+							 &posting, &posting_count);
+		MAPISTORE_RETVAL_IF(ret, ret, terms);
+		if (!i) {
+			mids = posting;
+			count = posting_count;
+		} else {
+			mapistore_content_index_intersect(mids, &count, posting, posting_count);
+			talloc_free(posting);
+		}
+		if (!count) break;
+	}
+	talloc_free(terms);
+
+	*midsp = mids;
+	*countp = count;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Candidates of a restriction. A conjunction is answered with
+   the intersection of its answerable members, a disjunction only when
+   each of its members can be answered. Without tdb, only check the
+   restriction can be answered.
+ */
+static enum mapistore_error mapistore_content_index_plan(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, uint64_t fid,
+							 const struct mapi_SRestriction *res, uint64_t **midsp, uint32_t *countp)
+{
+	const struct mapi_SRestriction	*child;
+	enum mapistore_error		ret;
+	uint64_t			*mids = NULL, *child_mids, *merged;
+	uint32_t			count = 0, child_count, i;
+	bool				planned = false;
+
+	switch (res->rt) {
+	case RES_CONTENT:
+		return mapistore_content_index_plan_content(mem_ctx, tdb, fid, &res->res.resContent, midsp, countp);
+	case RES_AND:
+		for (i = 0; i < res->res.resAnd.cRes; i++) {
+			child = (const struct mapi_SRestriction *)&res->res.resAnd.res[i];
+			ret = mapistore_content_index_plan(mem_ctx, tdb, fid, child, &child_mids, &child_count);
+			if (ret == MAPISTORE_ERR_NOT_AVAILABLE) continue;
+			MAPISTORE_RETVAL_IF(ret, ret, mids);
+			if (!planned) {
+				mids = child_mids;
+				count = child_count;
+				planned = true;
+			} else {
+				mapistore_content_index_intersect(mids, &count, child_mids, child_count);
+				talloc_free(child_mids);
+			}
+		}
+		MAPISTORE_RETVAL_IF(!planned, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+		break;
+	case RES_OR:
+		for (i = 0; i < res->res.resOr.cRes; i++) {
+			child = (const struct mapi_SRestriction *)&res->res.resOr.res[i];
+			ret = mapistore_content_index_plan(mem_ctx, tdb, fid, child, &child_mids, &child_count);
+			MAPISTORE_RETVAL_IF(ret, ret, mids);
+			merged = mapistore_content_index_union(mem_ctx, mids, count, child_mids, child_count, &count);
+			talloc_free(child_mids);
+			talloc_free(mids);
+			MAPISTORE_RETVAL_IF(!merged, MAPISTORE_ERR_NO_MEMORY, NULL);
+			mids = merged;
+			planned = true;
+		}
+		MAPISTORE_RETVAL_IF(!planned, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+		break;
+	default:
+		return MAPISTORE_ERR_NOT_AVAILABLE;
+	}
+
+	*midsp = mids;
+	*countp = count;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Retrieve the messages of a folder which may match a
+   restriction
+
+   The restriction is answered from the index when it is a content
+   restriction on an indexed property, or combines such restrictions.
+   The returned messages are a sorted superset of the matching ones, the
+   caller evaluates the restriction on each of them.
+
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+   \param res pointer to the restriction
+   \param midsp pointer to the returned array of message identifiers
+   \param countp pointer to the returned number of messages
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_AVAILABLE if
+   the restriction can not be answered from the index,
+   MAPISTORE_ERR_NOT_FOUND if it can but the folder is not indexed yet,
+   otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_content_index_query(TALLOC_CTX *mem_ctx, struct mapistore_context *mstore_ctx,
+							    const char *username, uint64_t fid,
+							    const struct mapi_SRestriction *res,
+							    uint64_t **midsp, uint32_t *countp)
+{
+	TALLOC_CTX		*local_mem_ctx;
+	struct tdb_context	*tdb;
+	uint8_t			buffer[MAPISTORE_CONTENT_INDEX_KEY_MAX];
+	enum mapistore_error	ret;
+	uint64_t		*mids, *unknown, *merged;
+	uint32_t		count, unknown_count;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username || !res, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!midsp || !countp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!content_index_enabled, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_content_index_open(local_mem_ctx, username, O_RDONLY);
+	if (tdb && !tdb_exists(tdb, mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_FOLDER, fid, 0, 0))) {
+		tdb_close(tdb);
+		tdb = NULL;
+	}
+	if (!tdb) {
+		/* Only worth building the folder index if it answers */
+		ret = mapistore_content_index_plan(local_mem_ctx, NULL, fid, res, &mids, &count);
+		talloc_free(local_mem_ctx);
+		return (ret == MAPISTORE_SUCCESS) ? MAPISTORE_ERR_NOT_FOUND : ret;
+	}
+
+	ret = mapistore_content_index_plan(local_mem_ctx, tdb, fid, res, &mids, &count);
+	if (ret == MAPISTORE_SUCCESS) {
+		ret = mapistore_content_index_list_fetch(local_mem_ctx, tdb,
+							 mapistore_content_index_key(buffer, MAPISTORE_CONTENT_INDEX_UNKNOWN, fid, 0, 0),
+							 &unknown, &unknown_count);
+	}
+	tdb_close(tdb);
+	MAPISTORE_RETVAL_IF(ret, ret, local_mem_ctx);
+
+	merged = mapistore_content_index_union(mem_ctx, mids, count, unknown, unknown_count, countp);
+	MAPISTORE_RETVAL_IF(!merged, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+	*midsp = merged;
+	talloc_free(local_mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
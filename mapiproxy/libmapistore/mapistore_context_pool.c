@@ -0,0 +1,279 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_context_pool.c
+
+   \brief Process-level pool of idle backend contexts
+
+   Clients reconnect often and every new session used to create its
+   backend contexts from scratch. When mapistore:context_pool_idle_time
+   is set, backend contexts released by a session, either through
+   mapistore_del_context or when the session ends, are parked in a pool
+   of the worker process instead of being destroyed. The next session
+   of the same user adding a context on the same URI gets the parked
+   one back.
+
+   Backends keep the connection info and the indexing context they were
+   created with. Pooled contexts are therefore created with a connection
+   info of their own, which is rebound to the session reusing them, and
+   the pool keeps their indexing context alive: a session looking for
+   the indexing context of a user adopts the pooled one rather than
+   opening a second one.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+
+struct mapistore_context_pool_entry {
+	struct mapistore_context_pool_entry	*prev;
+	struct mapistore_context_pool_entry	*next;
+	char					*username;
+	char					*owner;
+	struct backend_context			*backend_ctx;
+	time_t					released;
+};
+
+static uint32_t					pool_idle_time = 0;
+static uint32_t					pool_max_size = MAPISTORE_CONTEXT_POOL_SIZE;
+static uint32_t					pool_size = 0;
+static TALLOC_CTX				*pool_ctx = NULL;
+static struct mapistore_context_pool_entry	*pool = NULL;
+
+
+/**
+   \details Configure the backend context pool
+
+   \param idle_time the number of seconds an idle backend context is
+   kept, 0 disables the pool
+   \param max_size the maximum number of idle backend contexts kept by
+   the process
+ */
+_PUBLIC_ void mapistore_set_context_pool(uint32_t idle_time, uint32_t max_size)
+{
+	pool_idle_time = idle_time;
+	pool_max_size = max_size;
+}
+
+
+/**
+   \details Return whether backend contexts are pooled
+ */
+bool mapistore_context_pool_enabled(void)
+{
+	return (pool_idle_time && pool_max_size);
+}
+
+
+static void mapistore_context_pool_remove(struct mapistore_context_pool_entry *entry)
+{
+	OC_DEBUG(5, "dropping pooled context %s of %s", entry->backend_ctx->uri, entry->username);
+	DLIST_REMOVE(pool, entry);
+	pool_size--;
+	talloc_free(entry);
+}
+
+
+/**
+   \details Destroy the idle backend contexts which expired or exceed
+   the size of the pool. Entries are kept most recent first.
+ */
+static void mapistore_context_pool_sweep(void)
+{
+	struct mapistore_context_pool_entry	*entry, *next;
+	time_t					now = time(NULL);
+	uint32_t				i = 0;
+
+	for (entry = pool; entry; entry = next) {
+		next = entry->next;
+		i++;
+		if (i > pool_max_size || now - entry->released >= pool_idle_time) {
+			mapistore_context_pool_remove(entry);
+		}
+	}
+}
+
+
+/**
+   \details Point a connection info owned by a backend context to the
+   session described by another one
+
+   \param conn_info the connection info of the backend context
+   \param session_conn_info the connection info of the session
+ */
+void mapistore_context_pool_bind_conn_info(struct mapistore_connection_info *conn_info,
+					   const struct mapistore_connection_info *session_conn_info)
+{
+	if (conn_info->oc_ctx != session_conn_info->oc_ctx) {
+		if (conn_info->oc_ctx) {
+			talloc_unlink(conn_info, conn_info->oc_ctx);
+		}
+		(void) talloc_reference(conn_info, session_conn_info->oc_ctx);
+	}
+	if (conn_info->sam_ctx != session_conn_info->sam_ctx) {
+		if (conn_info->sam_ctx) {
+			talloc_unlink(conn_info, conn_info->sam_ctx);
+		}
+		(void) talloc_reference(conn_info, session_conn_info->sam_ctx);
+	}
+
+	conn_info->mstore_ctx = session_conn_info->mstore_ctx;
+	conn_info->oc_ctx = session_conn_info->oc_ctx;
+	conn_info->sam_ctx = session_conn_info->sam_ctx;
+	conn_info->replica_guid = session_conn_info->replica_guid;
+	conn_info->repl_id = session_conn_info->repl_id;
+	if (!conn_info->username || strcmp(conn_info->username, session_conn_info->username)) {
+		talloc_free(conn_info->username);
+		conn_info->username = talloc_strdup(conn_info, session_conn_info->username);
+	}
+}
+
+
+/**
+   \details Park a backend context released by a session in the pool
+
+   \param mstore_ctx pointer to the mapistore context releasing it
+   \param backend_ctx pointer to the backend context
+
+   \return MAPISTORE_SUCCESS if the pool took the backend context,
+   MAPISTORE_ERR_NOT_AVAILABLE if it must be destroyed
+ */
+enum mapistore_error mapistore_context_pool_park(struct mapistore_context *mstore_ctx, struct backend_context *backend_ctx)
+{
+	struct mapistore_context_pool_entry	*entry;
+
+	if (!mapistore_context_pool_enabled()) return MAPISTORE_ERR_NOT_AVAILABLE;
+	if (!backend_ctx->conn_info || !backend_ctx->uri || !backend_ctx->indexing) return MAPISTORE_ERR_NOT_AVAILABLE;
+	if (backend_ctx->root_deleted) return MAPISTORE_ERR_NOT_AVAILABLE;
+
+	if (!pool_ctx) {
+		pool_ctx = talloc_named(NULL, 0, "mapistore_context_pool");
+		MAPISTORE_RETVAL_IF(!pool_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+	}
+
+	entry = talloc_zero(pool_ctx, struct mapistore_context_pool_entry);
+	MAPISTORE_RETVAL_IF(!entry, MAPISTORE_ERR_NO_MEMORY, NULL);
+	entry->username = talloc_strdup(entry, backend_ctx->conn_info->username);
+	MAPISTORE_RETVAL_IF(!entry->username, MAPISTORE_ERR_NO_MEMORY, entry);
+	entry->owner = talloc_strdup(entry, backend_ctx->indexing->url);
+	MAPISTORE_RETVAL_IF(!entry->owner, MAPISTORE_ERR_NO_MEMORY, entry);
+
+	/* The indexing context belongs to the session, keep it alive */
+	if (!talloc_reference(entry, backend_ctx->indexing)) {
+		talloc_free(entry);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	entry->backend_ctx = talloc_steal(entry, backend_ctx);
+	entry->released = time(NULL);
+	backend_ctx->ref_count = 0;
+	backend_ctx->context_id = 0;
+	backend_ctx->conn_info->mstore_ctx = NULL;
+
+	DLIST_ADD(pool, entry);
+	pool_size++;
+	OC_DEBUG(5, "pooled context %s of %s (%"PRIu32" idle contexts)", backend_ctx->uri, entry->username, pool_size);
+
+	mapistore_context_pool_sweep();
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Take back an idle backend context from the pool
+
+   \param mstore_ctx pointer to the mapistore context of the session
+   \param ictx pointer to the indexing context of the owner in the
+   session
+   \param uri the URI of the context
+   \param backend_ctxp pointer on pointer to the backend context to
+   return
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if no
+   idle backend context can be reused
+ */
+enum mapistore_error mapistore_context_pool_take(struct mapistore_context *mstore_ctx, struct indexing_context *ictx,
+						 const char *uri, struct backend_context **backend_ctxp)
+{
+	struct mapistore_context_pool_entry	*entry;
+	struct backend_context			*backend_ctx;
+
+	if (!pool) return MAPISTORE_ERR_NOT_FOUND;
+	if (!mstore_ctx->conn_info || !ictx) return MAPISTORE_ERR_NOT_FOUND;
+
+	mapistore_context_pool_sweep();
+
+	for (entry = pool; entry; entry = entry->next) {
+		if (!strcmp(entry->backend_ctx->uri, uri) &&
+		    !strcmp(entry->owner, ictx->url) &&
+		    !strcmp(entry->username, mstore_ctx->conn_info->username)) {
+			break;
+		}
+	}
+	MAPISTORE_RETVAL_IF(!entry, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	/* The backend holds on to the indexing context it was created
+	 * with, the session must use the same one */
+	if (entry->backend_ctx->indexing != ictx) {
+		mapistore_context_pool_remove(entry);
+		return MAPISTORE_ERR_NOT_FOUND;
+	}
+
+	backend_ctx = talloc_steal(mstore_ctx, entry->backend_ctx);
+	mapistore_context_pool_bind_conn_info(backend_ctx->conn_info, mstore_ctx->conn_info);
+	backend_ctx->ref_count = 1;
+
+	DLIST_REMOVE(pool, entry);
+	pool_size--;
+	talloc_free(entry);
+
+	OC_DEBUG(5, "reusing pooled context %s", backend_ctx->uri);
+	*backend_ctxp = backend_ctx;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Return the indexing context kept alive by the pool for a
+   given user, so sessions share it with the pooled backend contexts
+
+   \param username the owner of the indexing context
+
+   \return pointer to the indexing context, NULL if the pool has none
+ */
+struct indexing_context *mapistore_context_pool_get_indexing(const char *username)
+{
+	struct mapistore_context_pool_entry	*entry;
+
+	for (entry = pool; entry; entry = entry->next) {
+		if (!strcmp(entry->owner, username)) {
+			return entry->backend_ctx->indexing;
+		}
+	}
+
+	return NULL;
+}
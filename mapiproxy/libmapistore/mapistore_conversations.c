@@ -0,0 +1,622 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_conversations.c
+
+   \brief Index of the conversations of a mailbox
+
+   Each conversation of a mailbox has a record in a TDB file of the
+   owner's mapistore directory listing its messages, whatever folder
+   they are in, sorted by delivery time. Each indexed message has a
+   record giving its conversation, so deleted and moved messages are
+   found without knowing their properties.
+
+   Conversations are identified by the 16 bytes of their
+   PidTagConversationId, computed by the caller.
+ */
+
+#include <string.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+#include "libmapi/libmapi_private.h"
+
+#include <tdb.h>
+
+#define	MAPISTORE_CONVERSATIONS_VERSION		1
+#define	MAPISTORE_CONVERSATIONS_MEMBERS		'C'
+#define	MAPISTORE_CONVERSATIONS_MESSAGE		'M'
+#define	MAPISTORE_CONVERSATIONS_MEMBERS_KEY	(1 + MAPISTORE_CONVERSATION_ID_SIZE)
+#define	MAPISTORE_CONVERSATIONS_MESSAGE_KEY	9
+
+struct mapistore_conversation {
+	uint32_t				count;
+	struct mapistore_conversation_member	*members;
+};
+
+static bool	conversations_enabled = false;
+
+/**
+   \details Configure the conversation index
+
+   \param enabled whether conversations are indexed
+ */
+_PUBLIC_ void mapistore_set_conversations(bool enabled)
+{
+	conversations_enabled = enabled;
+}
+
+/**
+   \details Tell whether the conversation index is enabled
+
+   \return true if conversations are indexed, otherwise false
+ */
+_PUBLIC_ bool mapistore_conversations_enabled(void)
+{
+	return conversations_enabled;
+}
+
+static struct tdb_context *mapistore_conversations_open(TALLOC_CTX *mem_ctx, const char *username, int open_flags)
+{
+	struct tdb_context	*tdb;
+	char			*dbpath;
+
+	if (open_flags & O_CREAT) {
+		dbpath = talloc_asprintf(mem_ctx, "%s/%s", mapistore_get_mapping_path(), username);
+		if (!dbpath) return NULL;
+		mkdir(dbpath, 0700);
+		talloc_free(dbpath);
+	}
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/%s/" MAPISTORE_DB_CONVERSATIONS,
+				 mapistore_get_mapping_path(), username);
+	if (!dbpath) return NULL;
+
+	tdb = tdb_open(dbpath, 0, 0, open_flags, 0600);
+	if (!tdb && (open_flags & O_CREAT)) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
+	}
+	talloc_free(dbpath);
+
+	return tdb;
+}
+
+static TDB_DATA mapistore_conversations_members_key(uint8_t *buffer, const uint8_t *id)
+{
+	TDB_DATA	key;
+
+	buffer[0] = MAPISTORE_CONVERSATIONS_MEMBERS;
+	memcpy(buffer + 1, id, MAPISTORE_CONVERSATION_ID_SIZE);
+	key.dptr = buffer;
+	key.dsize = MAPISTORE_CONVERSATIONS_MEMBERS_KEY;
+
+	return key;
+}
+
+static TDB_DATA mapistore_conversations_message_key(uint8_t *buffer, uint64_t mid)
+{
+	TDB_DATA	key;
+	int		i;
+
+	buffer[0] = MAPISTORE_CONVERSATIONS_MESSAGE;
+	for (i = 8; i > 0; i--) {
+		buffer[i] = mid & 0xff;
+		mid >>= 8;
+	}
+	key.dptr = buffer;
+	key.dsize = MAPISTORE_CONVERSATIONS_MESSAGE_KEY;
+
+	return key;
+}
+
+/**
+   \details Read the members of a conversation
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if the
+   conversation has no member, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_conversations_fetch(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, const uint8_t *id,
+							  struct mapistore_conversation **conversationp)
+{
+	struct mapistore_conversation	*conversation;
+	struct ndr_pull			*ndr;
+	uint8_t				buffer[MAPISTORE_CONVERSATIONS_MEMBERS_KEY];
+	TDB_DATA			data;
+	DATA_BLOB			blob;
+	uint8_t				version;
+	uint32_t			i;
+
+	data = tdb_fetch(tdb, mapistore_conversations_members_key(buffer, id));
+	MAPISTORE_RETVAL_IF(!data.dptr, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	conversation = talloc_zero(mem_ctx, struct mapistore_conversation);
+	if (!conversation) {
+		free(data.dptr);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	blob.data = data.dptr;
+	blob.length = data.dsize;
+	ndr = ndr_pull_init_blob(&blob, conversation);
+	if (!ndr) {
+		free(data.dptr);
+		talloc_free(conversation);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	if (ndr_pull_uint8(ndr, NDR_SCALARS, &version) != NDR_ERR_SUCCESS || version != MAPISTORE_CONVERSATIONS_VERSION
+	    || ndr_pull_uint32(ndr, NDR_SCALARS, &conversation->count) != NDR_ERR_SUCCESS
+	    || conversation->count > data.dsize / 24) {
+		goto corrupted;
+	}
+
+	conversation->members = talloc_array(conversation, struct mapistore_conversation_member, conversation->count + 1);
+	if (!conversation->members) {
+		free(data.dptr);
+		talloc_free(conversation);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	for (i = 0; i < conversation->count; i++) {
+		if (ndr_pull_hyper(ndr, NDR_SCALARS, &conversation->members[i].fid) != NDR_ERR_SUCCESS
+		    || ndr_pull_hyper(ndr, NDR_SCALARS, &conversation->members[i].mid) != NDR_ERR_SUCCESS
+		    || ndr_pull_hyper(ndr, NDR_SCALARS, &conversation->members[i].time) != NDR_ERR_SUCCESS) {
+			goto corrupted;
+		}
+	}
+	free(data.dptr);
+	talloc_free(ndr);
+
+	*conversationp = conversation;
+
+	return MAPISTORE_SUCCESS;
+
+corrupted:
+	OC_DEBUG(3, "corrupted conversation record");
+	free(data.dptr);
+	talloc_free(conversation);
+	return MAPISTORE_ERR_CORRUPTED;
+}
+
+static enum mapistore_error mapistore_conversations_store(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, const uint8_t *id,
+							  const struct mapistore_conversation *conversation)
+{
+	struct ndr_push		*ndr;
+	uint8_t			buffer[MAPISTORE_CONVERSATIONS_MEMBERS_KEY];
+	TDB_DATA		data;
+	uint32_t		i;
+	int			ret;
+
+	if (!conversation->count) {
+		tdb_delete(tdb, mapistore_conversations_members_key(buffer, id));
+		return MAPISTORE_SUCCESS;
+	}
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+	ndr_push_uint8(ndr, NDR_SCALARS, MAPISTORE_CONVERSATIONS_VERSION);
+	ndr_push_uint32(ndr, NDR_SCALARS, conversation->count);
+	for (i = 0; i < conversation->count; i++) {
+		ndr_push_hyper(ndr, NDR_SCALARS, conversation->members[i].fid);
+		ndr_push_hyper(ndr, NDR_SCALARS, conversation->members[i].mid);
+		ndr_push_hyper(ndr, NDR_SCALARS, conversation->members[i].time);
+	}
+
+	data.dptr = ndr->data;
+	data.dsize = ndr->offset;
+	ret = tdb_store(tdb, mapistore_conversations_members_key(buffer, id), data, TDB_REPLACE);
+	talloc_free(ndr);
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERR_DATABASE_OPS, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Read the conversation and the time of an indexed message
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if the
+   message is not indexed, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_conversations_message_fetch(struct tdb_context *tdb, uint64_t mid, uint8_t *id, uint64_t *timep)
+{
+	uint8_t		buffer[MAPISTORE_CONVERSATIONS_MESSAGE_KEY];
+	TDB_DATA	data;
+	uint64_t	time = 0;
+	int		i;
+
+	data = tdb_fetch(tdb, mapistore_conversations_message_key(buffer, mid));
+	MAPISTORE_RETVAL_IF(!data.dptr, MAPISTORE_ERR_NOT_FOUND, NULL);
+	if (data.dsize != MAPISTORE_CONVERSATION_ID_SIZE + 8) {
+		free(data.dptr);
+		return MAPISTORE_ERR_CORRUPTED;
+	}
+
+	memcpy(id, data.dptr, MAPISTORE_CONVERSATION_ID_SIZE);
+	for (i = 0; i < 8; i++) {
+		time = (time << 8) | data.dptr[MAPISTORE_CONVERSATION_ID_SIZE + i];
+	}
+	if (timep) {
+		*timep = time;
+	}
+	free(data.dptr);
+
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error mapistore_conversations_message_store(struct tdb_context *tdb, uint64_t mid, const uint8_t *id, uint64_t time)
+{
+	uint8_t		buffer[MAPISTORE_CONVERSATIONS_MESSAGE_KEY];
+	uint8_t		value[MAPISTORE_CONVERSATION_ID_SIZE + 8];
+	TDB_DATA	data;
+	int		i;
+
+	memcpy(value, id, MAPISTORE_CONVERSATION_ID_SIZE);
+	for (i = 7; i >= 0; i--) {
+		value[MAPISTORE_CONVERSATION_ID_SIZE + i] = time & 0xff;
+		time >>= 8;
+	}
+	data.dptr = value;
+	data.dsize = sizeof (value);
+	MAPISTORE_RETVAL_IF(tdb_store(tdb, mapistore_conversations_message_key(buffer, mid), data, TDB_REPLACE),
+			    MAPISTORE_ERR_DATABASE_OPS, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Remove a message from its conversation, if it is indexed
+ */
+static enum mapistore_error mapistore_conversations_remove(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, uint64_t mid)
+{
+	struct mapistore_conversation	*conversation;
+	uint8_t				id[MAPISTORE_CONVERSATION_ID_SIZE];
+	uint8_t				buffer[MAPISTORE_CONVERSATIONS_MESSAGE_KEY];
+	enum mapistore_error		ret;
+	uint32_t			i;
+
+	ret = mapistore_conversations_message_fetch(tdb, mid, id, NULL);
+	MAPISTORE_RETVAL_IF(ret == MAPISTORE_ERR_NOT_FOUND, MAPISTORE_SUCCESS, NULL);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+
+	tdb_delete(tdb, mapistore_conversations_message_key(buffer, mid));
+
+	ret = mapistore_conversations_fetch(mem_ctx, tdb, id, &conversation);
+	MAPISTORE_RETVAL_IF(ret == MAPISTORE_ERR_NOT_FOUND, MAPISTORE_SUCCESS, NULL);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+
+	for (i = 0; i < conversation->count; i++) {
+		if (conversation->members[i].mid == mid) {
+			memmove(conversation->members + i, conversation->members + i + 1,
+				(conversation->count - i - 1) * sizeof (struct mapistore_conversation_member));
+			conversation->count--;
+			break;
+		}
+	}
+	ret = mapistore_conversations_store(mem_ctx, tdb, id, conversation);
+	talloc_free(conversation);
+
+	return ret;
+}
+
+/**
+   \details Add a message to a conversation, keeping the members sorted
+   by time. The oldest members are dropped beyond
+   MAPISTORE_CONVERSATION_MAX_MEMBERS.
+ */
+static enum mapistore_error mapistore_conversations_insert(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, const uint8_t *id,
+							   uint64_t fid, uint64_t mid, uint64_t time)
+{
+	struct mapistore_conversation	*conversation;
+	struct mapistore_conversation_member	*members;
+	uint8_t				buffer[MAPISTORE_CONVERSATIONS_MESSAGE_KEY];
+	enum mapistore_error		ret;
+	uint32_t			pos;
+	bool				dropped = false;
+
+	ret = mapistore_conversations_remove(mem_ctx, tdb, mid);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+
+	ret = mapistore_conversations_fetch(mem_ctx, tdb, id, &conversation);
+	if (ret == MAPISTORE_ERR_NOT_FOUND || ret == MAPISTORE_ERR_CORRUPTED) {
+		conversation = talloc_zero(mem_ctx, struct mapistore_conversation);
+		MAPISTORE_RETVAL_IF(!conversation, MAPISTORE_ERR_NO_MEMORY, NULL);
+	} else if (ret != MAPISTORE_SUCCESS) {
+		return ret;
+	}
+
+	members = talloc_realloc(conversation, conversation->members, struct mapistore_conversation_member,
+				 conversation->count + 1);
+	MAPISTORE_RETVAL_IF(!members, MAPISTORE_ERR_NO_MEMORY, conversation);
+	conversation->members = members;
+
+	for (pos = conversation->count; pos > 0 && members[pos - 1].time > time; pos--);
+	memmove(members + pos + 1, members + pos, (conversation->count - pos) * sizeof (struct mapistore_conversation_member));
+	members[pos].fid = fid;
+	members[pos].mid = mid;
+	members[pos].time = time;
+	conversation->count++;
+
+	if (conversation->count > MAPISTORE_CONVERSATION_MAX_MEMBERS) {
+		if (members[0].mid == mid) {
+			dropped = true;
+		} else {
+			tdb_delete(tdb, mapistore_conversations_message_key(buffer, members[0].mid));
+		}
+		memmove(members, members + 1, (conversation->count - 1) * sizeof (struct mapistore_conversation_member));
+		conversation->count--;
+	}
+
+	ret = mapistore_conversations_store(mem_ctx, tdb, id, conversation);
+	if (ret == MAPISTORE_SUCCESS && !dropped) {
+		ret = mapistore_conversations_message_store(tdb, mid, id, time);
+	}
+	talloc_free(conversation);
+
+	return ret;
+}
+
+static struct tdb_context *mapistore_conversations_begin(TALLOC_CTX *mem_ctx, const char *username)
+{
+	struct tdb_context	*tdb;
+
+	tdb = mapistore_conversations_open(mem_ctx, username, O_RDWR|O_CREAT);
+	if (!tdb) return NULL;
+
+	if (tdb_transaction_start(tdb) != 0) {
+		tdb_close(tdb);
+		return NULL;
+	}
+
+	return tdb;
+}
+
+static enum mapistore_error mapistore_conversations_end(struct tdb_context *tdb, enum mapistore_error ret)
+{
+	if (ret == MAPISTORE_SUCCESS) {
+		if (tdb_transaction_commit(tdb) != 0) {
+			ret = MAPISTORE_ERR_DATABASE_OPS;
+		}
+	} else {
+		tdb_transaction_cancel(tdb);
+	}
+	tdb_close(tdb);
+
+	return ret;
+}
+
+/**
+   \details Index a message in a conversation, or move it there if it
+   belonged to another one
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param id the conversation identifier, MAPISTORE_CONVERSATION_ID_SIZE
+   bytes
+   \param fid the identifier of the folder holding the message
+   \param mid the message identifier
+   \param time the delivery time of the message, as a NTTIME
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_conversations_add(struct mapistore_context *mstore_ctx, const char *username,
+							  const uint8_t *id, uint64_t fid, uint64_t mid, uint64_t time)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	enum mapistore_error	ret;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username || !id, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!conversations_enabled, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_conversations_begin(mem_ctx, username);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
+
+	ret = mapistore_conversations_insert(mem_ctx, tdb, id, fid, mid, time);
+	ret = mapistore_conversations_end(tdb, ret);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Index copied or moved messages in the conversations of
+   their source messages
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the identifier of the folder receiving the messages
+   \param count number of messages
+   \param source_mids the identifiers of the source messages
+   \param target_mids the identifiers of the new messages
+   \param move whether the source messages are gone
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_conversations_copy(struct mapistore_context *mstore_ctx, const char *username,
+							   uint64_t fid, uint32_t count, const uint64_t *source_mids,
+							   const uint64_t *target_mids, bool move)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	uint8_t			id[MAPISTORE_CONVERSATION_ID_SIZE];
+	uint64_t		time;
+	enum mapistore_error	ret = MAPISTORE_SUCCESS;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && (!source_mids || !target_mids), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!count || !conversations_enabled, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_conversations_begin(mem_ctx, username);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
+
+	for (i = 0; ret == MAPISTORE_SUCCESS && i < count; i++) {
+		ret = mapistore_conversations_message_fetch(tdb, source_mids[i], id, &time);
+		if (ret == MAPISTORE_ERR_NOT_FOUND) {
+			ret = MAPISTORE_SUCCESS;
+			continue;
+		}
+		if (ret != MAPISTORE_SUCCESS) break;
+
+		if (move) {
+			ret = mapistore_conversations_remove(mem_ctx, tdb, source_mids[i]);
+		}
+		if (ret == MAPISTORE_SUCCESS) {
+			ret = mapistore_conversations_insert(mem_ctx, tdb, id, fid, target_mids[i], time);
+		}
+	}
+
+	ret = mapistore_conversations_end(tdb, ret);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Remove deleted messages from their conversations
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param count number of message identifiers
+   \param mids array of message identifiers
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_conversations_del(struct mapistore_context *mstore_ctx, const char *username,
+							  uint32_t count, const uint64_t *mids)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	enum mapistore_error	ret = MAPISTORE_SUCCESS;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!count || !conversations_enabled, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_conversations_begin(mem_ctx, username);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
+
+	for (i = 0; ret == MAPISTORE_SUCCESS && i < count; i++) {
+		ret = mapistore_conversations_remove(mem_ctx, tdb, mids[i]);
+	}
+
+	ret = mapistore_conversations_end(tdb, ret);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Get the conversation of an indexed message
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param mid the message identifier
+   \param id pointer to the returned conversation identifier,
+   MAPISTORE_CONVERSATION_ID_SIZE bytes
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if the
+   message is not indexed, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_conversations_get_id(struct mapistore_context *mstore_ctx, const char *username,
+							     uint64_t mid, uint8_t *id)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	enum mapistore_error	ret;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username || !id, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!conversations_enabled, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_conversations_open(mem_ctx, username, O_RDONLY);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_NOT_FOUND, mem_ctx);
+
+	ret = mapistore_conversations_message_fetch(tdb, mid, id, NULL);
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Get the messages of a conversation, in all the folders of
+   the mailbox
+
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param id the conversation identifier
+   \param membersp pointer to the returned members, oldest first
+   \param countp pointer to the number of returned members
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if the
+   conversation has no indexed message, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_conversations_get(TALLOC_CTX *mem_ctx, struct mapistore_context *mstore_ctx,
+							  const char *username, const uint8_t *id,
+							  struct mapistore_conversation_member **membersp, uint32_t *countp)
+{
+	TALLOC_CTX			*local_mem_ctx;
+	struct tdb_context		*tdb;
+	struct mapistore_conversation	*conversation;
+	enum mapistore_error		ret;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username || !id || !membersp || !countp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!conversations_enabled, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_conversations_open(local_mem_ctx, username, O_RDONLY);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_NOT_FOUND, local_mem_ctx);
+
+	ret = mapistore_conversations_fetch(local_mem_ctx, tdb, id, &conversation);
+	tdb_close(tdb);
+	if (ret == MAPISTORE_SUCCESS) {
+		*membersp = talloc_steal(mem_ctx, conversation->members);
+		*countp = conversation->count;
+	}
+	talloc_free(local_mem_ctx);
+
+	return ret;
+}
@@ -0,0 +1,515 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_freebusy.c
+
+   \brief Persisted free/busy summary of calendar folders
+
+   The summary of a calendar is the list of the appointments overlapping
+   the default free/busy publishing range, with their start, end and
+   busy status. It is stored in a TDB file of the calendar owner's
+   mapistore directory, keyed by folder ID, so free/busy requests can
+   be served without scanning the calendar. emsmdbp updates it when
+   appointments are saved or deleted, and it is rebuilt when the
+   publishing range moves or when it is older than the maximum age.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+#include "libmapi/libmapi_private.h"
+
+#include <tdb.h>
+
+#define	MAPISTORE_FREEBUSY_SUMMARY_VERSION	1
+
+static uint32_t freebusy_summary_max_age = MAPISTORE_FREEBUSY_SUMMARY_MAX_AGE;
+
+/**
+   In-memory copy of a calendar summary
+ */
+struct mapistore_freebusy_summary {
+	time_t					built;
+	uint32_t				publish_start;
+	uint32_t				publish_end;
+	uint32_t				count;
+	struct mapistore_freebusy_event		*events;
+};
+
+/**
+   \details Set the number of seconds after which a free/busy summary
+   is rebuilt from the calendar. Changes made to the calendar outside
+   of emsmdbp are picked up after this delay. 0 disables the summaries.
+
+   \param max_age the maximum age in seconds
+ */
+_PUBLIC_ void mapistore_set_freebusy_summary_max_age(uint32_t max_age)
+{
+	freebusy_summary_max_age = max_age;
+}
+
+static struct tdb_context *mapistore_freebusy_summary_open(TALLOC_CTX *mem_ctx, const char *username, int open_flags)
+{
+	struct tdb_context	*tdb;
+	char			*dbpath;
+
+	if (open_flags & O_CREAT) {
+		dbpath = talloc_asprintf(mem_ctx, "%s/%s", mapistore_get_mapping_path(), username);
+		if (!dbpath) return NULL;
+		mkdir(dbpath, 0700);
+		talloc_free(dbpath);
+	}
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/%s/" MAPISTORE_DB_FREEBUSY,
+				 mapistore_get_mapping_path(), username);
+	if (!dbpath) return NULL;
+
+	tdb = tdb_open(dbpath, 0, 0, open_flags, 0600);
+	if (!tdb && (open_flags & O_CREAT)) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
+	}
+	talloc_free(dbpath);
+
+	return tdb;
+}
+
+static TDB_DATA mapistore_freebusy_summary_key(TALLOC_CTX *mem_ctx, uint64_t fid)
+{
+	TDB_DATA	key;
+
+	key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%.16"PRIx64, fid);
+	key.dsize = key.dptr ? strlen((const char *) key.dptr) : 0;
+
+	return key;
+}
+
+static enum mapistore_error mapistore_freebusy_summary_pull(TALLOC_CTX *mem_ctx, TDB_DATA data, struct mapistore_freebusy_summary *summary)
+{
+	struct ndr_pull			*ndr;
+	DATA_BLOB			blob;
+	uint32_t			version, i;
+	NTTIME				built;
+	struct mapistore_freebusy_event	*event;
+
+	blob.data = data.dptr;
+	blob.length = data.dsize;
+	ndr = ndr_pull_init_blob(&blob, mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	if (ndr_pull_uint32(ndr, NDR_SCALARS, &version) != NDR_ERR_SUCCESS
+	    || version != MAPISTORE_FREEBUSY_SUMMARY_VERSION
+	    || ndr_pull_hyper(ndr, NDR_SCALARS, &built) != NDR_ERR_SUCCESS
+	    || ndr_pull_uint32(ndr, NDR_SCALARS, &summary->publish_start) != NDR_ERR_SUCCESS
+	    || ndr_pull_uint32(ndr, NDR_SCALARS, &summary->publish_end) != NDR_ERR_SUCCESS
+	    || ndr_pull_uint32(ndr, NDR_SCALARS, &summary->count) != NDR_ERR_SUCCESS) {
+		talloc_free(ndr);
+		return MAPISTORE_ERR_CORRUPTED;
+	}
+	summary->built = (time_t) built;
+
+	summary->events = talloc_array(mem_ctx, struct mapistore_freebusy_event, summary->count);
+	MAPISTORE_RETVAL_IF(summary->count && !summary->events, MAPISTORE_ERR_NO_MEMORY, ndr);
+	for (i = 0; i < summary->count; i++) {
+		event = summary->events + i;
+		if (ndr_pull_hyper(ndr, NDR_SCALARS, &event->mid) != NDR_ERR_SUCCESS
+		    || ndr_pull_uint32(ndr, NDR_SCALARS, &event->start.dwLowDateTime) != NDR_ERR_SUCCESS
+		    || ndr_pull_uint32(ndr, NDR_SCALARS, &event->start.dwHighDateTime) != NDR_ERR_SUCCESS
+		    || ndr_pull_uint32(ndr, NDR_SCALARS, &event->end.dwLowDateTime) != NDR_ERR_SUCCESS
+		    || ndr_pull_uint32(ndr, NDR_SCALARS, &event->end.dwHighDateTime) != NDR_ERR_SUCCESS
+		    || ndr_pull_uint32(ndr, NDR_SCALARS, &event->busy_status) != NDR_ERR_SUCCESS) {
+			talloc_free(ndr);
+			return MAPISTORE_ERR_CORRUPTED;
+		}
+	}
+
+	talloc_free(ndr);
+
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error mapistore_freebusy_summary_push(TALLOC_CTX *mem_ctx, const struct mapistore_freebusy_summary *summary, TDB_DATA *data)
+{
+	struct ndr_push				*ndr;
+	uint32_t				i;
+	const struct mapistore_freebusy_event	*event;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	ndr_push_uint32(ndr, NDR_SCALARS, MAPISTORE_FREEBUSY_SUMMARY_VERSION);
+	ndr_push_hyper(ndr, NDR_SCALARS, (NTTIME) summary->built);
+	ndr_push_uint32(ndr, NDR_SCALARS, summary->publish_start);
+	ndr_push_uint32(ndr, NDR_SCALARS, summary->publish_end);
+	ndr_push_uint32(ndr, NDR_SCALARS, summary->count);
+	for (i = 0; i < summary->count; i++) {
+		event = summary->events + i;
+		ndr_push_hyper(ndr, NDR_SCALARS, event->mid);
+		ndr_push_uint32(ndr, NDR_SCALARS, event->start.dwLowDateTime);
+		ndr_push_uint32(ndr, NDR_SCALARS, event->start.dwHighDateTime);
+		ndr_push_uint32(ndr, NDR_SCALARS, event->end.dwLowDateTime);
+		ndr_push_uint32(ndr, NDR_SCALARS, event->end.dwHighDateTime);
+		ndr_push_uint32(ndr, NDR_SCALARS, event->busy_status);
+	}
+
+	data->dptr = ndr->data;
+	data->dsize = ndr->offset;
+
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error mapistore_freebusy_summary_fetch(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, TDB_DATA key, struct mapistore_freebusy_summary *summary)
+{
+	TDB_DATA		data;
+	enum mapistore_error	ret;
+
+	data = tdb_fetch(tdb, key);
+	MAPISTORE_RETVAL_IF(!data.dptr, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	ret = mapistore_freebusy_summary_pull(mem_ctx, data, summary);
+	free(data.dptr);
+
+	return ret;
+}
+
+/**
+   \details Tell whether an event overlaps the publishing range of a
+   summary, using the same bounds as the calendar scan
+
+   \param summary pointer to the summary
+   \param event pointer to the event
+
+   \return true if the event belongs to the summary, otherwise false
+ */
+static bool mapistore_freebusy_summary_in_range(const struct mapistore_freebusy_summary *summary, const struct mapistore_freebusy_event *event)
+{
+	NTTIME		start, end;
+
+	start = ((NTTIME) event->start.dwHighDateTime << 32) | event->start.dwLowDateTime;
+	end = ((NTTIME) event->end.dwHighDateTime << 32) | event->end.dwLowDateTime;
+
+	return (end / (60 * 10000000ULL) >= summary->publish_start
+		&& start / (60 * 10000000ULL) <= summary->publish_end);
+}
+
+/**
+   \details Load the summary of a calendar if it is still valid for the
+   given publishing range
+
+   \param mem_ctx pointer to the memory context
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+   \param publish_start start of the range, in minutes since 1601
+   \param publish_end end of the range, in minutes since 1601
+   \param events pointer to the returned array of events
+   \param count pointer to the returned number of events
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if no
+   valid summary exists, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_freebusy_summary_load(TALLOC_CTX *mem_ctx, const char *username, uint64_t fid,
+						     uint32_t publish_start, uint32_t publish_end,
+						     struct mapistore_freebusy_event **events, uint32_t *count)
+{
+	TALLOC_CTX				*local_mem_ctx;
+	struct tdb_context			*tdb;
+	struct mapistore_freebusy_summary	summary;
+	enum mapistore_error			ret;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!events || !count, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!freebusy_summary_max_age, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_freebusy_summary_open(local_mem_ctx, username, O_RDONLY);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_NOT_FOUND, local_mem_ctx);
+
+	ret = mapistore_freebusy_summary_fetch(local_mem_ctx, tdb, mapistore_freebusy_summary_key(local_mem_ctx, fid), &summary);
+	tdb_close(tdb);
+	MAPISTORE_RETVAL_IF(ret, ret, local_mem_ctx);
+
+	if (summary.publish_start != publish_start || summary.publish_end != publish_end
+	    || time(NULL) - summary.built >= freebusy_summary_max_age) {
+		talloc_free(local_mem_ctx);
+		return MAPISTORE_ERR_NOT_FOUND;
+	}
+
+	*events = talloc_steal(mem_ctx, summary.events);
+	*count = summary.count;
+	talloc_free(local_mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Replace the summary of a calendar with a freshly scanned
+   list of events
+
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+   \param publish_start start of the range, in minutes since 1601
+   \param publish_end end of the range, in minutes since 1601
+   \param events array of events overlapping the range
+   \param count number of events
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_freebusy_summary_store(const char *username, uint64_t fid,
+						      uint32_t publish_start, uint32_t publish_end,
+						      const struct mapistore_freebusy_event *events, uint32_t count)
+{
+	TALLOC_CTX				*mem_ctx;
+	struct tdb_context			*tdb;
+	struct mapistore_freebusy_summary	summary;
+	TDB_DATA				data;
+	enum mapistore_error			ret;
+	int					tdb_ret;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !events, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!freebusy_summary_max_age, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	summary.built = time(NULL);
+	summary.publish_start = publish_start;
+	summary.publish_end = publish_end;
+	summary.count = count;
+	summary.events = discard_const_p(struct mapistore_freebusy_event, events);
+	ret = mapistore_freebusy_summary_push(mem_ctx, &summary, &data);
+	MAPISTORE_RETVAL_IF(ret, ret, mem_ctx);
+
+	tdb = mapistore_freebusy_summary_open(mem_ctx, username, O_RDWR|O_CREAT);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
+
+	tdb_ret = tdb_store(tdb, mapistore_freebusy_summary_key(mem_ctx, fid), data, TDB_REPLACE);
+	tdb_close(tdb);
+	MAPISTORE_RETVAL_IF(tdb_ret, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Tell whether a calendar has a free/busy summary to maintain
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the calendar owner
+   \param fid the folder identifier
+
+   \return true if a summary exists for the folder, otherwise false
+ */
+_PUBLIC_ bool mapistore_freebusy_summary_exists(struct mapistore_context *mstore_ctx, const char *username, uint64_t fid)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	bool			exists;
+
+	if (!mstore_ctx || !username || !freebusy_summary_max_age) return false;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return false;
+
+	tdb = mapistore_freebusy_summary_open(mem_ctx, username, O_RDONLY);
+	if (!tdb) {
+		talloc_free(mem_ctx);
+		return false;
+	}
+
+	exists = (tdb_exists(tdb, mapistore_freebusy_summary_key(mem_ctx, fid)) != 0);
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return exists;
+}
+
+/**
+   \details Apply a change to the summary of a calendar. The record is
+   locked during the update so concurrent sessions of the owner do not
+   lose each other's changes.
+
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+   \param event the saved event, or NULL when deleting
+   \param count number of deleted message identifiers
+   \param mids array of deleted message identifiers
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_freebusy_summary_apply(const char *username, uint64_t fid,
+							     const struct mapistore_freebusy_event *event,
+							     uint32_t count, const uint64_t *mids)
+{
+	TALLOC_CTX				*mem_ctx;
+	struct tdb_context			*tdb;
+	struct mapistore_freebusy_summary	summary;
+	struct mapistore_freebusy_event		*events;
+	TDB_DATA				key, data;
+	enum mapistore_error			ret;
+	uint32_t				i, j, kept;
+	bool					deleted;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_freebusy_summary_open(mem_ctx, username, O_RDWR);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_SUCCESS, mem_ctx);
+
+	key = mapistore_freebusy_summary_key(mem_ctx, fid);
+	if (tdb_chainlock(tdb, key) != 0) {
+		tdb_close(tdb);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	ret = mapistore_freebusy_summary_fetch(mem_ctx, tdb, key, &summary);
+	if (ret != MAPISTORE_SUCCESS) {
+		if (ret == MAPISTORE_ERR_NOT_FOUND) {
+			ret = MAPISTORE_SUCCESS;
+		} else {
+			tdb_delete(tdb, key);
+		}
+		goto end;
+	}
+
+	/* Drop the previous version of the saved event and the deleted ones */
+	kept = 0;
+	for (i = 0; i < summary.count; i++) {
+		deleted = (event && summary.events[i].mid == event->mid);
+		for (j = 0; !deleted && j < count; j++) {
+			deleted = (summary.events[i].mid == mids[j]);
+		}
+		if (!deleted) {
+			summary.events[kept++] = summary.events[i];
+		}
+	}
+	summary.count = kept;
+
+	if (event && mapistore_freebusy_summary_in_range(&summary, event)) {
+		events = talloc_realloc(mem_ctx, summary.events, struct mapistore_freebusy_event, summary.count + 1);
+		if (!events) {
+			tdb_delete(tdb, key);
+			ret = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+		events[summary.count++] = *event;
+		summary.events = events;
+	}
+
+	ret = mapistore_freebusy_summary_push(mem_ctx, &summary, &data);
+	if (ret != MAPISTORE_SUCCESS || tdb_store(tdb, key, data, TDB_REPLACE) != 0) {
+		/* A stale summary is worse than none */
+		tdb_delete(tdb, key);
+		ret = MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+end:
+	tdb_chainunlock(tdb, key);
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Record a saved appointment in the summary of its calendar,
+   if the calendar has one
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+   \param event the appointment start, end and busy status
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_freebusy_summary_update_event(struct mapistore_context *mstore_ctx, const char *username,
+								      uint64_t fid, const struct mapistore_freebusy_event *event)
+{
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!event, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	return mapistore_freebusy_summary_apply(username, fid, event, 0, NULL);
+}
+
+/**
+   \details Remove deleted messages from the summary of a calendar, if
+   the calendar has one
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+   \param count number of message identifiers
+   \param mids array of deleted message identifiers
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_freebusy_summary_delete_events(struct mapistore_context *mstore_ctx, const char *username,
+								       uint64_t fid, uint32_t count, const uint64_t *mids)
+{
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!count, MAPISTORE_SUCCESS, NULL);
+
+	return mapistore_freebusy_summary_apply(username, fid, NULL, count, mids);
+}
+
+/**
+   \details Drop the summary of a calendar, which is rebuilt by the next
+   free/busy request
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_freebusy_summary_invalidate(struct mapistore_context *mstore_ctx, const char *username, uint64_t fid)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_freebusy_summary_open(mem_ctx, username, O_RDWR);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_SUCCESS, mem_ctx);
+
+	tdb_delete(tdb, mapistore_freebusy_summary_key(mem_ctx, fid));
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
@@ -29,6 +29,8 @@
    This file contains functionality to map between folder / message
    identifiers and backend URI strings.
  */
+#include <time.h>
+
 #include "mapistore.h"
 #include "mapistore_errors.h"
 #include "mapistore_private.h"
@@ -36,9 +38,70 @@
 #include "backends/indexing_mysql.h"
 #include "mapiproxy/libmapiproxy/libmapiproxy.h"
 
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+#include "mapiproxy/util/ccan/htable/htable.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
+
 
 char *default_indexing_url = NULL;
 char *default_cache_url = NULL;
+static uint32_t default_lru_size = MAPISTORE_INDEXING_LRU_SIZE;
+static uint32_t default_lru_ttl = MAPISTORE_INDEXING_LRU_TTL;
+static uint32_t default_lease_size = 0;
+
+/* Indexing context kept by the process for later sessions */
+struct indexing_cache_entry {
+	struct indexing_cache_entry	*prev;
+	struct indexing_cache_entry	*next;
+	char				*username;
+	struct indexing_context		*ictx;
+};
+
+/* Most recently used first */
+static struct indexing_cache_entry	*indexing_cache = NULL;
+static struct htable			indexing_cache_ht;
+static TALLOC_CTX			*indexing_cache_ctx = NULL;
+static uint32_t				indexing_cache_count = 0;
+static uint32_t				indexing_cache_size = MAPISTORE_INDEXING_CACHE_SIZE;
+
+/* In-process cache entry mapping a fmid to its URI */
+struct indexing_lru_entry {
+	uint64_t			fmid;
+	char				*uri;
+	bool				soft_deleted;
+	time_t				stored;
+	struct indexing_lru_entry	*prev;
+	struct indexing_lru_entry	*next;
+};
+
+/* Bounded LRU cache wrapping the indexing backend operations */
+struct indexing_lru {
+	struct indexing_context		backend;
+	struct htable			fmid_ht;
+	struct htable			uri_ht;
+	struct indexing_lru_entry	*entries;
+	uint32_t			count;
+	uint32_t			size;
+	uint32_t			ttl;
+	uint64_t			generation;
+	uint64_t			hits;
+	uint64_t			misses;
+};
+
+/* Range of fmids allocated in one go and handed out by the process */
+struct indexing_lease {
+	struct indexing_context		*ictx;
+	enum mapistore_error		(*allocate_fmid)(struct indexing_context *, const char *, uint64_t *);
+	enum mapistore_error		(*allocate_fmids)(struct indexing_context *, const char *, int, uint64_t *);
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_t			lock;
+#endif
+	uint64_t			next;
+	uint64_t			end;
+	uint32_t			size;
+};
 
 /**
    \details Set the default backend url. If none is set, a tdb file per user
@@ -85,27 +148,869 @@ _PUBLIC_ char *mapistore_get_default_cache_url(void)
 	return default_cache_url;
 }
 
+/**
+   \details Set the maximum number of records kept in the per-process
+   indexing cache of contexts created afterwards. 0 disables the cache.
+
+   \param size maximum number of cached records
+ */
+_PUBLIC_ void mapistore_set_default_indexing_lru_size(uint32_t size)
+{
+	default_lru_size = size;
+}
+
+/**
+   \details Set the number of seconds records are served from the
+   indexing cache of contexts created afterwards. 0 keeps them until
+   they are evicted or invalidated.
+
+   \param ttl lifetime of cached records in seconds
+ */
+_PUBLIC_ void mapistore_set_default_indexing_lru_ttl(uint32_t ttl)
+{
+	default_lru_ttl = ttl;
+}
+
+static size_t indexing_lru_fmid_rehash(const void *e, void *unused)
+{
+	return hash_any(&((const struct indexing_lru_entry *)e)->fmid, sizeof(uint64_t), 0);
+}
+
+static size_t indexing_lru_uri_rehash(const void *e, void *unused)
+{
+	return hash_string(((const struct indexing_lru_entry *)e)->uri);
+}
+
+static struct indexing_lru_entry *indexing_lru_find_fmid(struct indexing_lru *lru, uint64_t fmid)
+{
+	struct htable_iter		iter;
+	struct indexing_lru_entry	*entry;
+	size_t				h = hash_any(&fmid, sizeof(uint64_t), 0);
+
+	for (entry = htable_firstval(&lru->fmid_ht, &iter, h); entry;
+	     entry = htable_nextval(&lru->fmid_ht, &iter, h)) {
+		if (entry->fmid == fmid) return entry;
+	}
+
+	return NULL;
+}
+
+static struct indexing_lru_entry *indexing_lru_find_uri(struct indexing_lru *lru, const char *uri)
+{
+	struct htable_iter		iter;
+	struct indexing_lru_entry	*entry;
+	size_t				h = hash_string(uri);
+
+	for (entry = htable_firstval(&lru->uri_ht, &iter, h); entry;
+	     entry = htable_nextval(&lru->uri_ht, &iter, h)) {
+		if (!strcmp(entry->uri, uri)) return entry;
+	}
+
+	return NULL;
+}
+
+static void indexing_lru_remove(struct indexing_lru *lru, struct indexing_lru_entry *entry)
+{
+	if (!entry) return;
+
+	htable_del(&lru->fmid_ht, indexing_lru_fmid_rehash(entry, NULL), entry);
+	htable_del(&lru->uri_ht, indexing_lru_uri_rehash(entry, NULL), entry);
+	DLIST_REMOVE(lru->entries, entry);
+	lru->count--;
+	talloc_free(entry);
+}
+
+static void indexing_lru_flush(struct indexing_lru *lru)
+{
+	while (lru->entries) {
+		indexing_lru_remove(lru, lru->entries);
+	}
+}
+
+/**
+   \details Drop the cached records if the backend data changed since
+   they were read. Backends without a change counter only rely on the
+   records lifetime.
+ */
+static void indexing_lru_validate(struct indexing_context *ictx)
+{
+	struct indexing_lru	*lru = ictx->lru;
+	uint64_t		generation;
+
+	if (!lru->backend.get_generation) return;
+
+	generation = lru->backend.get_generation(ictx);
+	if (generation != lru->generation) {
+		indexing_lru_flush(lru);
+		lru->generation = generation;
+	}
+}
+
+/**
+   \details Take the changes made through the context into account:
+   the records it cached are still valid. A change made by another
+   process between the write and this call goes unnoticed until the
+   next one or the records expire.
+ */
+static void indexing_lru_written(struct indexing_context *ictx)
+{
+	struct indexing_lru	*lru = ictx->lru;
+
+	if (lru->backend.get_generation) {
+		lru->generation = lru->backend.get_generation(ictx);
+	}
+}
+
+/**
+   \details Return the cached record of a fmid or a URI if it did not
+   expire, dropping it otherwise
+ */
+static struct indexing_lru_entry *indexing_lru_lookup(struct indexing_lru *lru, uint64_t fmid, const char *uri)
+{
+	struct indexing_lru_entry	*entry;
+
+	entry = uri ? indexing_lru_find_uri(lru, uri) : indexing_lru_find_fmid(lru, fmid);
+	if (entry && lru->ttl && time(NULL) - entry->stored >= lru->ttl) {
+		indexing_lru_remove(lru, entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+/**
+   \details Record a fmid/URI pair in the cache, evicting the least
+   recently used record when the cache is full. Existing records for
+   the same fmid or URI are replaced.
+ */
+static void indexing_lru_store(struct indexing_lru *lru, uint64_t fmid, const char *uri, bool soft_deleted)
+{
+	struct indexing_lru_entry	*entry;
+
+	if (!uri) return;
+
+	indexing_lru_remove(lru, indexing_lru_find_fmid(lru, fmid));
+	indexing_lru_remove(lru, indexing_lru_find_uri(lru, uri));
+	if (lru->count >= lru->size) {
+		indexing_lru_remove(lru, DLIST_TAIL(lru->entries));
+	}
+
+	entry = talloc_zero(lru, struct indexing_lru_entry);
+	if (!entry) return;
+	entry->fmid = fmid;
+	entry->soft_deleted = soft_deleted;
+	entry->stored = time(NULL);
+	entry->uri = talloc_strdup(entry, uri);
+	if (!entry->uri) {
+		talloc_free(entry);
+		return;
+	}
+
+	if (!htable_add(&lru->fmid_ht, indexing_lru_fmid_rehash(entry, NULL), entry)) {
+		talloc_free(entry);
+		return;
+	}
+	if (!htable_add(&lru->uri_ht, indexing_lru_uri_rehash(entry, NULL), entry)) {
+		htable_del(&lru->fmid_ht, indexing_lru_fmid_rehash(entry, NULL), entry);
+		talloc_free(entry);
+		return;
+	}
+	DLIST_ADD(lru->entries, entry);
+	lru->count++;
+}
+
+static enum mapistore_error indexing_lru_add_fmid(struct indexing_context *ictx, const char *username,
+						  uint64_t fmid, const char *uri)
+{
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	ret = ictx->lru->backend.add_fmid(ictx, username, fmid, uri);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+		indexing_lru_store(ictx->lru, fmid, uri, false);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_update_fmid(struct indexing_context *ictx, const char *username,
+						     uint64_t fmid, const char *uri)
+{
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	indexing_lru_remove(ictx->lru, indexing_lru_find_fmid(ictx->lru, fmid));
+	ret = ictx->lru->backend.update_fmid(ictx, username, fmid, uri);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+		indexing_lru_store(ictx->lru, fmid, uri, false);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_del_fmid(struct indexing_context *ictx, const char *username,
+						  uint64_t fmid, uint8_t flags)
+{
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	indexing_lru_remove(ictx->lru, indexing_lru_find_fmid(ictx->lru, fmid));
+	ret = ictx->lru->backend.del_fmid(ictx, username, fmid, flags);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_get_uri(struct indexing_context *ictx, const char *username,
+						 TALLOC_CTX *mem_ctx, uint64_t fmid, char **urip,
+						 bool *soft_deletedp)
+{
+	enum mapistore_error		ret;
+	struct indexing_lru_entry	*entry;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	entry = indexing_lru_lookup(ictx->lru, fmid, NULL);
+	if (entry && username && urip && soft_deletedp) {
+		*urip = talloc_strdup(mem_ctx, entry->uri);
+		MAPISTORE_RETVAL_IF(!*urip, MAPISTORE_ERR_NO_MEMORY, NULL);
+		*soft_deletedp = entry->soft_deleted;
+		DLIST_PROMOTE(ictx->lru->entries, entry);
+		ictx->lru->hits++;
+		mapistore_shared_stats_indexing(1, 0);
+		return MAPISTORE_SUCCESS;
+	}
+
+	ictx->lru->misses++;
+	mapistore_shared_stats_indexing(0, 1);
+	ret = ictx->lru->backend.get_uri(ictx, username, mem_ctx, fmid, urip, soft_deletedp);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_store(ictx->lru, fmid, *urip, *soft_deletedp);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_get_fmid(struct indexing_context *ictx, const char *username,
+						  const char *uri, bool partial, uint64_t *fmidp,
+						  bool *soft_deletedp)
+{
+	enum mapistore_error		ret;
+	struct indexing_lru_entry	*entry;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	/* Wildcard lookups always hit the backend */
+	if (partial || !uri) {
+		return ictx->lru->backend.get_fmid(ictx, username, uri, partial, fmidp, soft_deletedp);
+	}
+
+	indexing_lru_validate(ictx);
+	entry = indexing_lru_lookup(ictx->lru, 0, uri);
+	if (entry && username && fmidp && soft_deletedp) {
+		*fmidp = entry->fmid;
+		*soft_deletedp = entry->soft_deleted;
+		DLIST_PROMOTE(ictx->lru->entries, entry);
+		ictx->lru->hits++;
+		mapistore_shared_stats_indexing(1, 0);
+		return MAPISTORE_SUCCESS;
+	}
+
+	ictx->lru->misses++;
+	mapistore_shared_stats_indexing(0, 1);
+	ret = ictx->lru->backend.get_fmid(ictx, username, uri, partial, fmidp, soft_deletedp);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_store(ictx->lru, *fmidp, uri, *soft_deletedp);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_add_fmids(struct indexing_context *ictx, const char *username,
+						   uint32_t count, const uint64_t *fmids, const char **uris)
+{
+	enum mapistore_error	ret;
+	uint32_t		i;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	ret = ictx->lru->backend.add_fmids(ictx, username, count, fmids, uris);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+		for (i = 0; i < count; i++) {
+			indexing_lru_store(ictx->lru, fmids[i], uris[i], false);
+		}
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_del_fmids(struct indexing_context *ictx, const char *username,
+						   uint32_t count, const uint64_t *fmids, uint8_t flags)
+{
+	enum mapistore_error	ret;
+	uint32_t		i;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	for (i = 0; fmids && i < count; i++) {
+		indexing_lru_remove(ictx->lru, indexing_lru_find_fmid(ictx->lru, fmids[i]));
+	}
+
+	ret = ictx->lru->backend.del_fmids(ictx, username, count, fmids, flags);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_get_uris(struct indexing_context *ictx, const char *username,
+						  TALLOC_CTX *mem_ctx, uint32_t count, const uint64_t *fmids,
+						  char **uris, bool *soft_deleted)
+{
+	enum mapistore_error		ret;
+	struct indexing_lru_entry	*entry;
+	TALLOC_CTX			*local_mem_ctx;
+	uint64_t			*missing;
+	uint32_t			*missing_idx;
+	char				**missing_uris;
+	bool				*missing_soft_deleted;
+	uint32_t			missing_count = 0;
+	uint32_t			i;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	if (!username || !fmids || !uris || !soft_deleted) {
+		return ictx->lru->backend.get_uris(ictx, username, mem_ctx, count, fmids, uris, soft_deleted);
+	}
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+	missing = talloc_array(local_mem_ctx, uint64_t, count);
+	missing_idx = talloc_array(local_mem_ctx, uint32_t, count);
+	missing_uris = talloc_array(local_mem_ctx, char *, count);
+	missing_soft_deleted = talloc_array(local_mem_ctx, bool, count);
+	if (count && (!missing || !missing_idx || !missing_uris || !missing_soft_deleted)) {
+		talloc_free(local_mem_ctx);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	/* Serve what we can from the cache */
+	indexing_lru_validate(ictx);
+	for (i = 0; i < count; i++) {
+		entry = indexing_lru_lookup(ictx->lru, fmids[i], NULL);
+		if (entry) {
+			uris[i] = talloc_strdup(mem_ctx, entry->uri);
+			MAPISTORE_RETVAL_IF(!uris[i], MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+			soft_deleted[i] = entry->soft_deleted;
+			DLIST_PROMOTE(ictx->lru->entries, entry);
+			ictx->lru->hits++;
+		} else {
+			missing[missing_count] = fmids[i];
+			missing_idx[missing_count] = i;
+			missing_count++;
+			ictx->lru->misses++;
+		}
+	}
+	mapistore_shared_stats_indexing(count - missing_count, missing_count);
+
+	/* And fetch the remaining records in a single round-trip */
+	if (missing_count) {
+		ret = ictx->lru->backend.get_uris(ictx, username, mem_ctx, missing_count, missing,
+						  missing_uris, missing_soft_deleted);
+		MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
+
+		for (i = 0; i < missing_count; i++) {
+			uris[missing_idx[i]] = missing_uris[i];
+			soft_deleted[missing_idx[i]] = missing_soft_deleted[i];
+			indexing_lru_store(ictx->lru, missing[i], missing_uris[i], missing_soft_deleted[i]);
+		}
+	}
+
+	talloc_free(local_mem_ctx);
+	return MAPISTORE_SUCCESS;
+}
+
+/* The fmid counter lives in the backend too: allocating from it must
+   not make the cache look out of date */
+static enum mapistore_error indexing_lru_allocate_fmids(struct indexing_context *ictx, const char *username,
+							int count, uint64_t *fmidp)
+{
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	ret = ictx->lru->backend.allocate_fmids(ictx, username, count, fmidp);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_allocate_fmid(struct indexing_context *ictx, const char *username,
+						       uint64_t *fmidp)
+{
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	ret = ictx->lru->backend.allocate_fmid(ictx, username, fmidp);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+	}
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lru_release_fmids(struct indexing_context *ictx, const char *username,
+						       uint64_t fmid, int count)
+{
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	indexing_lru_validate(ictx);
+	ret = ictx->lru->backend.release_fmids(ictx, username, fmid, count);
+	if (ret == MAPISTORE_SUCCESS) {
+		indexing_lru_written(ictx);
+	}
+
+	return ret;
+}
+
+static int indexing_lru_destructor(struct indexing_lru *lru)
+{
+	struct indexing_context	*ictx = talloc_get_type(talloc_parent(lru), struct indexing_context);
+
+	/* Put the backend operations back, as the lease does */
+	if (ictx && ictx->lru == lru) {
+		ictx->add_fmid = lru->backend.add_fmid;
+		ictx->update_fmid = lru->backend.update_fmid;
+		ictx->del_fmid = lru->backend.del_fmid;
+		ictx->get_uri = lru->backend.get_uri;
+		ictx->get_fmid = lru->backend.get_fmid;
+		ictx->add_fmids = lru->backend.add_fmids;
+		ictx->del_fmids = lru->backend.del_fmids;
+		ictx->get_uris = lru->backend.get_uris;
+		if (ictx->allocate_fmid == indexing_lru_allocate_fmid) {
+			ictx->allocate_fmid = lru->backend.allocate_fmid;
+		}
+		if (ictx->allocate_fmids == indexing_lru_allocate_fmids) {
+			ictx->allocate_fmids = lru->backend.allocate_fmids;
+		}
+		if (ictx->release_fmids == indexing_lru_release_fmids) {
+			ictx->release_fmids = lru->backend.release_fmids;
+		}
+		ictx->lru = NULL;
+	}
+
+	OC_DEBUG(5, "[indexing] cache: %"PRIu64" hits, %"PRIu64" misses\n", lru->hits, lru->misses);
+	htable_clear(&lru->fmid_ht);
+	htable_clear(&lru->uri_ht);
+	return 0;
+}
+
+/**
+   \details Put a bounded in-process LRU cache in front of the
+   get_uri/get_fmid operations of an indexing context. Updates and
+   deletions performed through the context invalidate the cached
+   records. Changes made by other contexts or processes drop the whole
+   cache when the backend has a change counter; records otherwise
+   expire after mapistore_set_default_indexing_lru_ttl seconds.
+
+   \param ictx pointer to the indexing context to wrap
+   \param size maximum number of cached records
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_indexing_lru_init(struct indexing_context *ictx, uint32_t size)
+{
+	struct indexing_lru	*lru;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!size, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(ictx->lru, MAPISTORE_ERR_EXIST, NULL);
+
+	lru = talloc_zero(ictx, struct indexing_lru);
+	MAPISTORE_RETVAL_IF(!lru, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	lru->size = size;
+	lru->ttl = default_lru_ttl;
+	lru->backend = *ictx;
+	if (lru->backend.get_generation) {
+		lru->generation = lru->backend.get_generation(ictx);
+	}
+	htable_init(&lru->fmid_ht, indexing_lru_fmid_rehash, NULL);
+	htable_init(&lru->uri_ht, indexing_lru_uri_rehash, NULL);
+	talloc_set_destructor(lru, indexing_lru_destructor);
+
+	ictx->lru = lru;
+	ictx->add_fmid = indexing_lru_add_fmid;
+	ictx->update_fmid = indexing_lru_update_fmid;
+	ictx->del_fmid = indexing_lru_del_fmid;
+	ictx->get_uri = indexing_lru_get_uri;
+	ictx->get_fmid = indexing_lru_get_fmid;
+	ictx->add_fmids = indexing_lru_add_fmids;
+	ictx->del_fmids = indexing_lru_del_fmids;
+	ictx->get_uris = indexing_lru_get_uris;
+	if (ictx->get_generation) {
+		if (ictx->allocate_fmid) ictx->allocate_fmid = indexing_lru_allocate_fmid;
+		if (ictx->allocate_fmids) ictx->allocate_fmids = indexing_lru_allocate_fmids;
+		if (ictx->release_fmids) ictx->release_fmids = indexing_lru_release_fmids;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Retrieve the hit and miss counters of the indexing cache
+
+   \param ictx pointer to the indexing context
+   \param hitsp pointer to the number of lookups served from the cache
+   \param missesp pointer to the number of lookups sent to the backend
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_INITIALIZED
+   if the context has no cache
+ */
+_PUBLIC_ enum mapistore_error mapistore_indexing_lru_stats(struct indexing_context *ictx,
+							   uint64_t *hitsp, uint64_t *missesp)
+{
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!ictx->lru, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	if (hitsp) *hitsp = ictx->lru->hits;
+	if (missesp) *missesp = ictx->lru->misses;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Set the number of fmids the indexing contexts created
+   afterwards allocate from their backend at once. 0 disables leases.
+
+   \param size number of fmids per lease
+ */
+_PUBLIC_ void mapistore_set_default_fmid_lease_size(uint32_t size)
+{
+	default_lease_size = size;
+}
+
+/**
+   \details Take count fmids from the current lease without locking
+
+   The refill publishes the new next before the new end, so whoever
+   sees the new end also sees its compare-and-swap on the old next
+   fail.
+ */
+static bool indexing_lease_take(struct indexing_lease *lease, int count, uint64_t *fmidp)
+{
+	uint64_t	next;
+#if defined(HAVE_PTHREADS)
+	uint64_t	end;
+
+	do {
+		next = lease->next;
+		__sync_synchronize();
+		end = lease->end;
+		if (next + count > end) return false;
+	} while (!__sync_bool_compare_and_swap(&lease->next, next, next + count));
+#else
+	next = lease->next;
+	if (next + count > lease->end) return false;
+	lease->next = next + count;
+#endif
+
+	*fmidp = next;
+	return true;
+}
+
+static enum mapistore_error indexing_lease_allocate_fmids(struct indexing_context *ictx, const char *username,
+							  int count, uint64_t *fmidp)
+{
+	struct indexing_lease	*lease = ictx->lease;
+	enum mapistore_error	ret = MAPISTORE_SUCCESS;
+	uint64_t		first;
+
+	/* Large ranges are not worth a lease of their own */
+	if (count <= 0 || (uint32_t) count > lease->size / 4 || !fmidp) {
+		return lease->allocate_fmids(ictx, username, count, fmidp);
+	}
+
+	if (indexing_lease_take(lease, count, fmidp)) {
+		return MAPISTORE_SUCCESS;
+	}
+
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_lock(&lease->lock);
+#endif
+	if (!indexing_lease_take(lease, count, fmidp)) {
+		/* The tail of the exhausted lease is lost: the backend
+		   counter has moved past it */
+		ret = lease->allocate_fmids(ictx, username, lease->size, &first);
+		if (ret == MAPISTORE_SUCCESS) {
+			lease->next = first + count;
+#if defined(HAVE_PTHREADS)
+			__sync_synchronize();
+#endif
+			lease->end = first + lease->size;
+#if defined(HAVE_PTHREADS)
+			__sync_synchronize();
+#endif
+			*fmidp = first;
+		}
+	}
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_unlock(&lease->lock);
+#endif
+
+	return ret;
+}
+
+static enum mapistore_error indexing_lease_allocate_fmid(struct indexing_context *ictx, const char *username,
+							 uint64_t *fmidp)
+{
+	return indexing_lease_allocate_fmids(ictx, username, 1, fmidp);
+}
+
+static int indexing_lease_destructor(struct indexing_lease *lease)
+{
+	struct indexing_context	*ictx = lease->ictx;
+
+	/* Give the unused tail back if nobody allocated after it */
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_lock(&lease->lock);
+#endif
+	if (lease->next < lease->end && ictx->release_fmids) {
+		ictx->release_fmids(ictx, ictx->url, lease->next, lease->end - lease->next);
+	}
+	lease->next = lease->end;
+#if defined(HAVE_PTHREADS)
+	pthread_mutex_unlock(&lease->lock);
+	pthread_mutex_destroy(&lease->lock);
+#endif
+
+	/* The context allocates from its backend again */
+	if (ictx->lease == lease) {
+		ictx->allocate_fmid = lease->allocate_fmid;
+		ictx->allocate_fmids = lease->allocate_fmids;
+		ictx->lease = NULL;
+	}
+
+	return 0;
+}
+
+/**
+   \details Hand out the fmids allocated through an indexing context
+   from ranges of size fmids allocated at once, so concurrent
+   allocations only reach the backend once per range. The unused end
+   of the last range is given back when the context is released, if
+   the backend counter did not move since.
+
+   Processes sharing a mailbox then allocate from distinct ranges:
+   fmids no longer grow in allocation order across processes.
+
+   \param ictx pointer to the indexing context to wrap
+   \param size number of fmids per lease
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_indexing_lease_init(struct indexing_context *ictx, uint32_t size)
+{
+	struct indexing_lease	*lease;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!ictx->allocate_fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(size < 4, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(ictx->lease, MAPISTORE_ERR_EXIST, NULL);
+
+	lease = talloc_zero(ictx, struct indexing_lease);
+	MAPISTORE_RETVAL_IF(!lease, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+#if defined(HAVE_PTHREADS)
+	if (pthread_mutex_init(&lease->lock, NULL)) {
+		talloc_free(lease);
+		return MAPISTORE_ERROR;
+	}
+#endif
+	lease->ictx = ictx;
+	lease->allocate_fmid = ictx->allocate_fmid;
+	lease->allocate_fmids = ictx->allocate_fmids;
+	lease->size = size;
+	talloc_set_destructor(lease, indexing_lease_destructor);
+
+	ictx->lease = lease;
+	ictx->allocate_fmid = indexing_lease_allocate_fmid;
+	ictx->allocate_fmids = indexing_lease_allocate_fmids;
+
+	return MAPISTORE_SUCCESS;
+}
+
+static size_t indexing_cache_rehash(const void *e, void *unused)
+{
+	return hash_string(((const struct indexing_cache_entry *)e)->username);
+}
+
+static void indexing_cache_remove(struct indexing_cache_entry *entry)
+{
+	htable_del(&indexing_cache_ht, hash_string(entry->username), entry);
+	DLIST_REMOVE(indexing_cache, entry);
+	indexing_cache_count--;
+	/* Drops the reference, the sessions using the context keep it */
+	talloc_free(entry);
+}
+
+/**
+   \details Drop the least recently used indexing contexts exceeding
+   the size of the cache
+ */
+static void indexing_cache_trim(void)
+{
+	struct indexing_cache_entry	*entry;
+
+	while (indexing_cache_count > indexing_cache_size) {
+		for (entry = indexing_cache; entry->next; entry = entry->next);
+		OC_DEBUG(5, "[indexing] dropping cached context of %s\n", entry->username);
+		indexing_cache_remove(entry);
+	}
+}
+
+static struct indexing_cache_entry *indexing_cache_find(const char *username)
+{
+	struct indexing_cache_entry	*entry;
+	struct htable_iter		iter;
+	size_t				h;
+
+	if (!indexing_cache_count) return NULL;
+
+	h = hash_string(username);
+	for (entry = htable_firstval(&indexing_cache_ht, &iter, h); entry;
+	     entry = htable_nextval(&indexing_cache_ht, &iter, h)) {
+		if (!strcmp(entry->username, username)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+   \details Return the indexing context the process keeps for a user
+
+   \param username the owner of the indexing context
+
+   \return pointer to the indexing context, NULL if the cache has none
+ */
+static struct indexing_context *indexing_cache_get(const char *username)
+{
+	struct indexing_cache_entry	*entry;
+
+	entry = indexing_cache_find(username);
+	if (!entry) return NULL;
+
+	if (entry != indexing_cache) {
+		DLIST_REMOVE(indexing_cache, entry);
+		DLIST_ADD(indexing_cache, entry);
+	}
+
+	return entry->ictx;
+}
+
+/**
+   \details Keep an indexing context for the later sessions of the
+   process, evicting the least recently used ones beyond the size of
+   the cache
+ */
+static void indexing_cache_store(const char *username, struct indexing_context *ictx)
+{
+	struct indexing_cache_entry	*entry;
+
+	if (!indexing_cache_size) return;
+	if (indexing_cache_find(username)) return;
+
+	if (!indexing_cache_ctx) {
+		indexing_cache_ctx = talloc_named(NULL, 0, "mapistore_indexing_cache");
+		if (!indexing_cache_ctx) return;
+		htable_init(&indexing_cache_ht, indexing_cache_rehash, NULL);
+	}
+
+	entry = talloc_zero(indexing_cache_ctx, struct indexing_cache_entry);
+	if (!entry) return;
+	entry->username = talloc_strdup(entry, username);
+	if (!entry->username || !talloc_reference(entry, ictx)) {
+		talloc_free(entry);
+		return;
+	}
+	entry->ictx = ictx;
+	if (!htable_add(&indexing_cache_ht, hash_string(entry->username), entry)) {
+		talloc_free(entry);
+		return;
+	}
+
+	DLIST_ADD(indexing_cache, entry);
+	indexing_cache_count++;
+	indexing_cache_trim();
+}
+
+/**
+   \details Set the maximum number of indexing contexts a process keeps
+   for later sessions. 0 disables the cache.
+
+   \param size maximum number of cached indexing contexts
+ */
+_PUBLIC_ void mapistore_set_indexing_cache_size(uint32_t size)
+{
+	indexing_cache_size = size;
+	indexing_cache_trim();
+}
+
 /**
    \details Search the indexing record matching the username
 
    \param mstore_ctx pointer to the mapistore context
    \param username the username to lookup
 
-   \return pointer to the tdb_wrap structure on success, otherwise NULL
+   \return pointer to the indexing context on success, otherwise NULL
  */
 struct indexing_context *mapistore_indexing_search(struct mapistore_context *mstore_ctx,
 						   const char *username)
 {
+	struct processing_context	*pctx;
 	struct indexing_context_list	*el;
+	struct htable_iter		iter;
+	size_t				h;
 
 	/* Sanity checks */
-	if (!mstore_ctx) return NULL;
-	if (!mstore_ctx->indexing_list) return NULL;
+	if (!mstore_ctx || !mstore_ctx->processing_ctx) return NULL;
 	if (!username) return NULL;
 
-	for (el = mstore_ctx->indexing_list; el; el = el->next) {
-		/* TODO: extract url from backend mapping, by the moment we use the username */
-		if (el && el->ctx && !strcmp(el->ctx->url, username)) {
+	pctx = mstore_ctx->processing_ctx;
+	if (!pctx->indexing_ht.rehash) return NULL;
+
+	/* TODO: extract url from backend mapping, by the moment we use the username */
+	h = hash_string(username);
+	for (el = htable_firstval(&pctx->indexing_ht, &iter, h); el;
+	     el = htable_nextval(&pctx->indexing_ht, &iter, h)) {
+		if (!strcmp(el->ctx->url, username)) {
 			return el->ctx;
 		}
 	}
@@ -113,9 +1018,40 @@ struct indexing_context *mapistore_indexing_search(struct mapistore_context *mst
 	return NULL;
 }
 
+/**
+   \details Make an indexing context opened by another session
+   available to this one
+
+   \param mstore_ctx pointer to the mapistore context
+   \param ictx pointer to the shared indexing context
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_indexing_adopt(struct mapistore_context *mstore_ctx,
+						     struct indexing_context *ictx)
+{
+	struct indexing_context_list	*el;
+	enum mapistore_error		retval;
+
+	el = talloc_zero(mstore_ctx, struct indexing_context_list);
+	MAPISTORE_RETVAL_IF(!el, MAPISTORE_ERR_NO_MEMORY, NULL);
+	el->ctx = ictx;
+	MAPISTORE_RETVAL_IF(!talloc_reference(el, ictx), MAPISTORE_ERR_NO_MEMORY, el);
+
+	retval = mapistore_register_indexing(mstore_ctx->processing_ctx, el);
+	MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, el);
+	DLIST_ADD_END(mstore_ctx->indexing_list, el, struct indexing_context_list *);
+
+	return MAPISTORE_SUCCESS;
+}
+
 /**
    \details Open connection to indexing database for a given user
 
+   Indexing contexts are shared by the sessions of the process: the
+   most recently used ones are kept in a bounded cache after their
+   sessions end.
+
    \param mstore_ctx pointer to the mapistore context
    \param username name for which the indexing database has to be
    created
@@ -129,6 +1065,7 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_add(struct mapistore_context *m
 	struct indexing_context_list	*ictx;
 	const char			*indexing_url;
 	enum MAPISTATUS			retval;
+	enum mapistore_error		ret;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -138,6 +1075,18 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_add(struct mapistore_context *m
 	*ictxp = mapistore_indexing_search(mstore_ctx, username);
 	MAPISTORE_RETVAL_IF(*ictxp, MAPISTORE_SUCCESS, NULL);
 
+	/* Step 2. Share the one an earlier session of the process opened */
+	*ictxp = indexing_cache_get(username);
+	if (*ictxp) {
+		return mapistore_indexing_adopt(mstore_ctx, *ictxp);
+	}
+
+	/* Step 3. Share the one pooled backend contexts were created with */
+	*ictxp = mapistore_context_pool_get_indexing(username);
+	if (*ictxp) {
+		return mapistore_indexing_adopt(mstore_ctx, *ictxp);
+	}
+
 	// indexing context has not been found, let's create it.
 	retval = openchangedb_get_indexing_url(mstore_ctx->conn_info->oc_ctx, username, &indexing_url);
 	if (retval != MAPI_E_SUCCESS) {
@@ -157,8 +1106,20 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_add(struct mapistore_context *m
 		return MAPISTORE_ERROR;
 	}
 
+	if (ictx->ctx && default_lru_size) {
+		mapistore_indexing_lru_init(ictx->ctx, default_lru_size);
+	}
+	if (ictx->ctx && default_lease_size) {
+		mapistore_indexing_lease_init(ictx->ctx, default_lease_size);
+	}
+
+	MAPISTORE_RETVAL_IF(!ictx->ctx, MAPISTORE_ERR_CONTEXT_FAILED, ictx);
+	ret = mapistore_register_indexing(mstore_ctx->processing_ctx, ictx);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, ictx);
+
 	/* ictx->ref_count = 0; */
 	DLIST_ADD_END(mstore_ctx->indexing_list, ictx, struct indexing_context_list *);
+	indexing_cache_store(username, ictx->ctx);
 
 	*ictxp = ictx->ctx;
 	return MAPISTORE_SUCCESS;
@@ -196,7 +1157,7 @@ enum mapistore_error mapistore_indexing_record_add_fmid(struct mapistore_context
 	MAPISTORE_RETVAL_IF(invalid_type, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Ensure the context exists */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!backend_ctx->indexing, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
@@ -247,7 +1208,7 @@ enum mapistore_error mapistore_indexing_record_add_fmid_for_uri(struct mapistore
 	MAPISTORE_RETVAL_IF(!mapistore_uri, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Ensure the context exists */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!backend_ctx->indexing, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
@@ -288,7 +1249,7 @@ enum mapistore_error mapistore_indexing_record_del_fmid(struct mapistore_context
 	MAPISTORE_RETVAL_IF(!fmid, MAPISTORE_ERROR, NULL);
 
 	/* Ensure the context exists */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!backend_ctx->indexing, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
@@ -360,6 +1321,145 @@ _PUBLIC_ enum mapistore_error mapistore_indexing_record_get_fmid(struct mapistor
 	return ictx->get_fmid(ictx, username, uri, partial, fmidp, soft_deletedp);
 }
 
+/**
+   \details Add a set of folder or message records to the indexing
+   database in a single backend operation
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the indexing
+   database to update
+   \param username the username who owns the new entries
+   \param count the number of records to add
+   \param fmids the folder or message IDs to add
+   \param uris the URIs to map against the fmids, or NULL to retrieve
+   them from the backend
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_indexing_record_add_fmids(struct mapistore_context *mstore_ctx,
+								  uint32_t context_id, const char *username,
+								  uint32_t count, const uint64_t *fmids,
+								  const char **uris)
+{
+	struct backend_context		*backend_ctx;
+	struct indexing_context		*ictx;
+	enum mapistore_error		ret;
+	TALLOC_CTX			*mem_ctx;
+	char				*uri;
+	uint32_t			i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!context_id, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	/* Ensure the context exists */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!backend_ctx->indexing, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	ret = mapistore_indexing_add(mstore_ctx, username, &ictx);
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERROR, NULL);
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERROR, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* Retrieve the mapistore URIs given context_id and fmids */
+	if (!uris) {
+		uris = talloc_array(mem_ctx, const char *, count);
+		MAPISTORE_RETVAL_IF(!uris, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		for (i = 0; i < count; i++) {
+			ret = mapistore_backend_get_path(backend_ctx, mem_ctx, fmids[i], &uri);
+			MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, MAPISTORE_ERROR, mem_ctx);
+			uris[i] = uri;
+		}
+	}
+
+	ret = ictx->add_fmids(ictx, username, count, fmids, uris);
+
+	talloc_free(mem_ctx);
+	return ret;
+}
+
+/**
+   \details Remove a set of folder or message records from the
+   indexing database in a single backend operation
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the indexing
+   database to update
+   \param username the username who owns the entries
+   \param count the number of records to remove
+   \param fmids the folder or message IDs to delete
+   \param flags the type of deletion MAPISTORE_SOFT_DELETE or MAPISTORE_PERMANENT_DELETE
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_indexing_record_del_fmids(struct mapistore_context *mstore_ctx,
+								  uint32_t context_id, const char *username,
+								  uint32_t count, const uint64_t *fmids,
+								  uint8_t flags)
+{
+	struct backend_context		*backend_ctx;
+	struct indexing_context		*ictx;
+	enum mapistore_error		ret;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!context_id, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !fmids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count == 0, MAPISTORE_SUCCESS, NULL);
+
+	/* Ensure the context exists */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!backend_ctx->indexing, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	ret = mapistore_indexing_add(mstore_ctx, username, &ictx);
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERROR, NULL);
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERROR, NULL);
+
+	return ictx->del_fmids(ictx, username, count, fmids, flags);
+}
+
+/**
+   \details Returns the URIs of a set of records
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the name of the account where to look for the
+   indexing database
+   \param mem_ctx pointer to the memory context
+   \param count the number of records to look up
+   \param fmids the fmids/keys to the records
+   \param uris array of count elements filled with the URIs, NULL
+   entries for unknown fmids
+   \param soft_deleted array of count elements filled with the soft
+   deleted state of each record
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_indexing_record_get_uris(struct mapistore_context *mstore_ctx, const char *username, TALLOC_CTX *mem_ctx, uint32_t count, const uint64_t *fmids, char **uris, bool *soft_deleted)
+{
+	struct indexing_context	*ictx;
+	int			ret;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!uris, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!soft_deleted, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	ret = mapistore_indexing_add(mstore_ctx, username, &ictx);
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERROR, NULL);
+	MAPISTORE_RETVAL_IF(!ictx, MAPISTORE_ERROR, NULL);
+
+	return ictx->get_uris(ictx, username, mem_ctx, count, fmids, uris, soft_deleted);
+}
+
 /**
    \details Add a fid record to the indexing database
 
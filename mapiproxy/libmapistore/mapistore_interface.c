@@ -22,6 +22,7 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "mapistore.h"
 #include "mapistore_errors.h"
@@ -30,12 +31,226 @@
 
 #include "utils/dlinklist.h"
 #include "libmapi/libmapi_private.h"
+#include "mapiproxy/util/trace.h"
 
 #include <string.h>
 
+/**
+   \details Hand the backend contexts still open over to the context
+   pool when the mapistore context is released
+ */
+static int mapistore_context_destructor(struct mapistore_context *mstore_ctx)
+{
+	struct backend_context_list	*el;
+
+	for (el = mstore_ctx->context_list; el; el = el->next) {
+		if (el->ctx) {
+			mapistore_context_pool_park(mstore_ctx, el->ctx);
+		}
+	}
+
+	return 0;
+}
+
+/* The process wide part of the mapistore contexts: loading the
+   backends and opening the named properties database and the
+   notification client is only done once, and the result is shared by
+   every context initialized with the same configuration. A core is
+   not shared with the processes forked after it was initialized: they
+   inherit the loaded backends and the named properties cache, but
+   open their own connections. */
+struct mapistore_core {
+	pid_t					pid;
+	struct loadparm_context			*lp_ctx;
+	void					*guard;
+	char					*path;
+	struct namedprops_context		*nprops_ctx;
+	struct mapistore_notification_context	*notification_ctx;
+};
+
+static struct mapistore_core	*mapistore_core = NULL;
+
+/**
+   \details Forget the shared core when the loadparm context it was
+   initialized from goes away. Contexts still using it keep their
+   reference.
+ */
+static int mapistore_core_guard_destructor(void *guard)
+{
+	struct mapistore_core	*core = mapistore_core;
+
+	if (core && core->guard == guard) {
+		core->guard = NULL;
+		mapistore_core = NULL;
+		talloc_unlink(NULL, core);
+	}
+
+	return 0;
+}
+
+/**
+   \details Return the shared mapistore core for the given
+   configuration, initializing it on first use
+
+   \param lp_ctx loadparm_context to get smb.conf options
+   \param path the path to the location to load the backend providers from (NULL for default)
+
+   \return the mapistore core on success, otherwise NULL
+ */
+static struct mapistore_core *mapistore_core_get(struct loadparm_context *lp_ctx, const char *path)
+{
+	enum mapistore_error	retval;
+	struct mapistore_core	*core;
+	const char		*indexing_url;
+	const char		*cache_url;
+	const char		*replica_mapping_url;
+	int			lru_size;
+	int			lru_ttl;
+	int			indexing_cache_size;
+	int			lease_size;
+	int			fb_max_age;
+	int			tombstones_max_age;
+	int			slow_call;
+	int			pool_idle_time;
+	int			pool_size;
+	bool			lazy;
+	bool			parallel;
+
+	if (mapistore_core && mapistore_core->pid == getpid() && mapistore_core->lp_ctx == lp_ctx &&
+	    ((!path && !mapistore_core->path) ||
+	     (path && mapistore_core->path && !strcmp(path, mapistore_core->path)))) {
+		return mapistore_core;
+	}
+
+	core = talloc_zero(NULL, struct mapistore_core);
+	if (!core) return NULL;
+
+	core->pid = getpid();
+	core->lp_ctx = lp_ctx;
+	if (path) {
+		core->path = talloc_strdup(core, path);
+		if (!core->path) goto error;
+	}
+
+	lazy = lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "lazy_backends", false);
+	parallel = lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "backend_init_parallel", false);
+	retval = mapistore_backend_init(core, path, lazy, parallel);
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "mapistore_backend_init: %s", mapistore_errstr(retval));
+		goto error;
+	}
+
+	indexing_url = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "indexing_backend");
+	mapistore_set_default_indexing_url(indexing_url);
+
+	replica_mapping_url = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "replica_mapping_backend");
+	mapistore_set_default_replica_mapping_url(replica_mapping_url);
+
+	retval = mapistore_namedprops_init(core, lp_ctx, &(core->nprops_ctx));
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "ERROR: %s", mapistore_errstr(retval));
+		goto error;
+	}
+
+	retval = mapistore_notification_init(core, lp_ctx, &(core->notification_ctx));
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "[mapistore]: Unable to initialize mapistore notification subsystem: %s\n", mapistore_errstr(retval));
+		goto error;
+	}
+
+	cache_url = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "indexing_cache");
+	mapistore_set_default_cache_url(cache_url);
+
+	lru_size = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "indexing_lru_size", MAPISTORE_INDEXING_LRU_SIZE);
+	mapistore_set_default_indexing_lru_size(lru_size > 0 ? lru_size : 0);
+
+	lru_ttl = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "indexing_lru_ttl", MAPISTORE_INDEXING_LRU_TTL);
+	mapistore_set_default_indexing_lru_ttl(lru_ttl > 0 ? lru_ttl : 0);
+
+	indexing_cache_size = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "indexing_context_cache_size", MAPISTORE_INDEXING_CACHE_SIZE);
+	mapistore_set_indexing_cache_size(indexing_cache_size > 0 ? indexing_cache_size : 0);
+
+	lease_size = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "fmid_lease_size", 0);
+	mapistore_set_default_fmid_lease_size(lease_size >= 4 ? lease_size : 0);
+
+	fb_max_age = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "freebusy_summary_max_age", MAPISTORE_FREEBUSY_SUMMARY_MAX_AGE);
+	mapistore_set_freebusy_summary_max_age(fb_max_age > 0 ? fb_max_age : 0);
+
+	mapistore_set_content_index(lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "content_index", false));
+
+	tombstones_max_age = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "tombstones_max_age", MAPISTORE_TOMBSTONES_MAX_AGE);
+	mapistore_set_tombstones(lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "tombstones", false),
+				 tombstones_max_age > 0 ? tombstones_max_age : 0);
+
+	mapistore_set_attachment_store(lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "attachment_store", false));
+	mapistore_set_conversations(lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "conversations", false));
+
+	slow_call = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "backend_slow_call", 0);
+	mapistore_set_backend_profiling(lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "backend_profiling", false),
+					slow_call > 0 ? slow_call : 0);
+
+	pool_idle_time = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "context_pool_idle_time", 0);
+	pool_size = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "context_pool_size", MAPISTORE_CONTEXT_POOL_SIZE);
+	mapistore_set_context_pool(pool_idle_time > 0 ? pool_idle_time : 0, pool_size > 0 ? pool_size : 0);
+
+	/* Replace the core of a previous configuration */
+	if (mapistore_core) {
+		talloc_free(mapistore_core->guard);
+	}
+
+	core->guard = talloc_named_const(lp_ctx, 0, "mapistore_core_guard");
+	if (!core->guard) goto error;
+	talloc_set_destructor(core->guard, mapistore_core_guard_destructor);
+	mapistore_core = core;
+
+	return core;
+
+error:
+	talloc_free(core);
+	return NULL;
+}
+
+
+/**
+   \details Initialize the process-wide part of mapistore and fill its
+   caches, so that the first sessions do not pay for it
+
+   This is meant to be called by the endpoints when they are
+   initialized, before the server starts accepting connections.
+
+   \param lp_ctx loadparm_context to get smb.conf options
+   \param path the path to the location to load the backend providers from (NULL for default)
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_warmup(struct loadparm_context *lp_ctx, const char *path)
+{
+	struct mapistore_core	*core;
+	enum mapistore_error	retval;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!lp_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	core = mapistore_core_get(lp_ctx, path);
+	MAPISTORE_RETVAL_IF(!core, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	retval = mapistore_namedprops_cache_preload(core->nprops_ctx);
+	if (retval != MAPISTORE_SUCCESS && retval != MAPISTORE_ERR_NOT_AVAILABLE) {
+		OC_DEBUG(1, "unable to preload the named properties: %s", mapistore_errstr(retval));
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
 /**
    \details Initialize the mapistore context
 
+   The backends, the named properties database and the notification
+   client are shared by all the contexts of the process initialized
+   with the same configuration: only the per-session state is
+   allocated here.
+
    \param mem_ctx pointer to the memory context
    \param lp_ctx loadparm_context to get smb.conf options
    \param path the path to the location to load the backend providers from (NULL for default)
@@ -46,10 +261,9 @@ _PUBLIC_ struct mapistore_context *mapistore_init(TALLOC_CTX *mem_ctx, struct lo
 {
 	int				retval;
 	struct mapistore_context	*mstore_ctx;
+	struct mapistore_core		*core;
 	const char			*private_dir;
 	char				*mapping_path;
-	const char			*indexing_url;
-	const char			*cache_url;
 
 	if (!lp_ctx) {
 		return NULL;
@@ -65,6 +279,7 @@ _PUBLIC_ struct mapistore_context *mapistore_init(TALLOC_CTX *mem_ctx, struct lo
 	private_dir = lpcfg_private_dir(lp_ctx);
 	if (!private_dir) {
 		OC_DEBUG(5, "private directory was not returned from configuration");
+		talloc_free(mstore_ctx);
 		return NULL;
 	}
 
@@ -83,41 +298,23 @@ _PUBLIC_ struct mapistore_context *mapistore_init(TALLOC_CTX *mem_ctx, struct lo
 		return NULL;
 	}
 
-	retval = mapistore_backend_init(mstore_ctx, path);
-	if (retval != MAPISTORE_SUCCESS) {
-		OC_DEBUG(0, "mapistore_backend_init: %s", mapistore_errstr(retval));
+	core = mapistore_core_get(lp_ctx, path);
+	if (!core || !talloc_reference(mstore_ctx, core)) {
 		talloc_free(mstore_ctx);
 		return NULL;
 	}
 
+	mstore_ctx->core = core;
 	mstore_ctx->context_list = NULL;
 	mstore_ctx->indexing_list = talloc_zero(mstore_ctx, struct indexing_context_list);
 	mstore_ctx->replica_mapping_list = talloc_zero(mstore_ctx, struct replica_mapping_context_list);
 	mstore_ctx->notifications = NULL;
 	mstore_ctx->subscriptions = NULL;
 	mstore_ctx->conn_info = NULL;
-	mstore_ctx->notification_ctx = NULL;
-
-	indexing_url = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "indexing_backend");
-	mapistore_set_default_indexing_url(indexing_url);
-
-	mstore_ctx->nprops_ctx = NULL;
-	retval = mapistore_namedprops_init(mstore_ctx, lp_ctx, &(mstore_ctx->nprops_ctx));
-	if (retval != MAPISTORE_SUCCESS) {
-		OC_DEBUG(0, "ERROR: %s", mapistore_errstr(retval));
-		talloc_free(mstore_ctx);
-		return NULL;
-	}
-
-	retval = mapistore_notification_init(mstore_ctx, lp_ctx, &(mstore_ctx->notification_ctx));
-	if (retval != MAPISTORE_SUCCESS) {
-		OC_DEBUG(0, "[mapistore]: Unable to initialize mapistore notification subsystem: %s\n", mapistore_errstr(retval));
-		talloc_free(mstore_ctx);
-		return NULL;
-	}
+	mstore_ctx->nprops_ctx = core->nprops_ctx;
+	mstore_ctx->notification_ctx = core->notification_ctx;
 
-	cache_url = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "indexing_cache");
-	mapistore_set_default_cache_url(cache_url);
+	talloc_set_destructor(mstore_ctx, mapistore_context_destructor);
 
 	return mstore_ctx;
 }
@@ -142,6 +339,7 @@ _PUBLIC_ enum mapistore_error mapistore_release(struct mapistore_context *mstore
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
 
 	OC_DEBUG(5, "freeing up mstore_ctx ref: %p", mstore_ctx);
+	mapistore_backend_profile_dump();
 
 	return MAPISTORE_SUCCESS;
 }
@@ -195,6 +393,7 @@ _PUBLIC_ enum mapistore_error mapistore_add_context(struct mapistore_context *ms
 	char					*namespace_start;
 	char					*backend_uri;
 	struct indexing_context			*ictx;
+	struct mapistore_connection_info	*conn_info;
 
 	/* Step 1. Perform Sanity Checks on URI */
 	if (!uri || strlen(uri) < 4) {
@@ -219,13 +418,27 @@ _PUBLIC_ enum mapistore_error mapistore_add_context(struct mapistore_context *ms
 		backend_uri = talloc_strdup(mem_ctx, &namespace[3]);
 		namespace[3] = '\0';
 
-		retval = mapistore_backend_create_context(mstore_ctx, mstore_ctx->conn_info, ictx, namespace_start, backend_uri, fid, &backend_ctx);
-		if (retval != MAPISTORE_SUCCESS) {
-			talloc_free(mem_ctx);
-			return retval;
-		}
+		if (mapistore_context_pool_take(mstore_ctx, ictx, uri, &backend_ctx) != MAPISTORE_SUCCESS) {
+			/* Contexts which may be pooled need a connection
+			 * info they can be rebound to another session with */
+			conn_info = mstore_ctx->conn_info;
+			if (conn_info && mapistore_context_pool_enabled()) {
+				conn_info = talloc_zero(mem_ctx, struct mapistore_connection_info);
+				MAPISTORE_RETVAL_IF(!conn_info, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+				mapistore_context_pool_bind_conn_info(conn_info, mstore_ctx->conn_info);
+			}
+
+			retval = mapistore_backend_create_context(mstore_ctx, conn_info, ictx, namespace_start, backend_uri, fid, &backend_ctx);
+			if (retval != MAPISTORE_SUCCESS) {
+				talloc_free(mem_ctx);
+				return retval;
+			}
 
-		backend_ctx->indexing = ictx;
+			if (conn_info != mstore_ctx->conn_info) {
+				backend_ctx->conn_info = talloc_steal(backend_ctx, conn_info);
+			}
+			backend_ctx->indexing = ictx;
+		}
 
 		backend_list = talloc_zero((TALLOC_CTX *) mstore_ctx, struct backend_context_list);
 		backend_list->ctx = backend_ctx;
@@ -234,6 +447,12 @@ _PUBLIC_ enum mapistore_error mapistore_add_context(struct mapistore_context *ms
 			talloc_free(mem_ctx);
 			return MAPISTORE_ERR_CONTEXT_FAILED;
 		}
+		retval = mapistore_register_context(mstore_ctx->processing_ctx, backend_list);
+		if (retval != MAPISTORE_SUCCESS) {
+			mapistore_free_context_id(mstore_ctx->processing_ctx, backend_list->ctx->context_id);
+			talloc_free(mem_ctx);
+			return MAPISTORE_ERR_CONTEXT_FAILED;
+		}
 		*context_id = backend_list->ctx->context_id;
 		*backend_object = backend_list->ctx->root_folder_object;
 		DLIST_ADD_END(mstore_ctx->context_list, backend_list, struct backend_context_list *);
@@ -270,7 +489,7 @@ _PUBLIC_ enum mapistore_error mapistore_add_context_ref_count(struct mapistore_c
 
 	/* Step 0. Ensure the context exists */
 	OC_DEBUG(0, "mapistore_add_context_ref_count: context_is to increment is %d", context_id);
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 1. Increment the ref count */
@@ -307,7 +526,7 @@ _PUBLIC_ enum mapistore_error mapistore_search_context_by_uri(struct mapistore_c
 
 	if (!uri) return MAPISTORE_ERROR;
 
-	backend_ctx = mapistore_backend_lookup_by_uri(mstore_ctx->context_list, uri);
+	backend_ctx = mapistore_backend_lookup_by_uri(mstore_ctx, uri);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_NOT_FOUND, NULL);
 
 	*context_id = backend_ctx->context_id;
@@ -332,7 +551,6 @@ _PUBLIC_ enum mapistore_error mapistore_del_context(struct mapistore_context *ms
 	struct backend_context_list	*backend_list;
 	struct backend_context		*backend_ctx;
 	int				retval;
-	bool				found = false;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
@@ -341,19 +559,11 @@ _PUBLIC_ enum mapistore_error mapistore_del_context(struct mapistore_context *ms
 
 	/* Step 0. Ensure the context exists */
 	OC_DEBUG(5, "mapistore_del_context: context_id to del is %d", context_id);
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
-	/* search the backend_list item */
-	for (backend_list = mstore_ctx->context_list; backend_list; backend_list = backend_list->next) {
-		if (backend_list->ctx->context_id == context_id) {
-			found = true;
-			break;
-		}
-	}
-	if (found == false) {
-		return MAPISTORE_ERROR;
-	}
+	/* the backend_list item is indexed by context identifier */
+	backend_list = mstore_ctx->processing_ctx->contexts[context_id];
 
 	/* Step 1. Release the indexing context within backend */
 	/* if (backend_ctx->indexing) {
@@ -366,8 +576,17 @@ _PUBLIC_ enum mapistore_error mapistore_del_context(struct mapistore_context *ms
 		}
 	} */
 
-	/* Step 2. Delete the context within backend */
-	retval = mapistore_backend_delete_context(backend_ctx);
+	/* The last reference goes away: the context is about to be parked or freed */
+	if (backend_ctx->ref_count == 1) {
+		mapistore_unregister_context(mstore_ctx->processing_ctx, backend_list);
+	}
+
+	/* Step 2. Delete the context within backend, unless the pool keeps it for a later session */
+	if (backend_ctx->ref_count == 1 && mapistore_context_pool_park(mstore_ctx, backend_ctx) == MAPISTORE_SUCCESS) {
+		retval = MAPISTORE_SUCCESS;
+	} else {
+		retval = mapistore_backend_delete_context(backend_ctx);
+	}
 	
 	switch (retval) {
 	case MAPISTORE_ERR_REF_COUNT:
@@ -493,16 +712,22 @@ _PUBLIC_ enum mapistore_error mapistore_folder_open_folder(struct mapistore_cont
 							   void *folder, TALLOC_CTX *mem_ctx, uint64_t fid, void **child_folder)
 {
 	struct backend_context		*backend_ctx;
+	enum mapistore_error		ret;
+	struct oc_trace_span		span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend open_folder */
-	return mapistore_backend_folder_open_folder(backend_ctx, folder, mem_ctx, fid, child_folder);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_open_folder(backend_ctx, folder, mem_ctx, fid, child_folder);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 /**
@@ -522,16 +747,22 @@ _PUBLIC_ enum mapistore_error mapistore_folder_create_folder(struct mapistore_co
 							     void *folder, TALLOC_CTX *mem_ctx, uint64_t fid, struct SRow *aRow, void **child_folder)
 {
 	struct backend_context		*backend_ctx;
+	enum mapistore_error		ret;
+	struct oc_trace_span		span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);	
 	
 	/* Step 2. Call backend create_folder */
-	return mapistore_backend_folder_create_folder(backend_ctx, folder, mem_ctx, fid, aRow, child_folder);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_create_folder(backend_ctx, folder, mem_ctx, fid, aRow, child_folder);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 
@@ -567,7 +798,7 @@ _PUBLIC_ enum mapistore_error mapistore_folder_delete(struct mapistore_context *
 	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
 
 	/* Step 1. Find the backend context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	if (!backend_ctx) {
 		ret = MAPISTORE_ERR_INVALID_PARAMETER;
 		goto end;
@@ -663,6 +894,10 @@ _PUBLIC_ enum mapistore_error mapistore_folder_delete(struct mapistore_context *
 
 	/* Step 3. Call backend delete_folder */
 	ret = mapistore_backend_folder_delete(backend_ctx, folder);
+	if (ret == MAPISTORE_SUCCESS && folder == backend_ctx->root_folder_object) {
+		/* the context must not be reused from the pool */
+		backend_ctx->root_deleted = true;
+	}
 
 end:
 	*deleted_fmids_count_p = deleted_count;
@@ -687,16 +922,22 @@ _PUBLIC_ enum mapistore_error mapistore_folder_open_message(struct mapistore_con
 							    void *folder, TALLOC_CTX *mem_ctx, uint64_t mid, bool read_write, void **messagep)
 {
 	struct backend_context		*backend_ctx;
+	enum mapistore_error		ret;
+	struct oc_trace_span		span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend open_message */
-	return mapistore_backend_folder_open_message(backend_ctx, folder, mem_ctx, mid, read_write, messagep);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_open_message(backend_ctx, folder, mem_ctx, mid, read_write, messagep);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 
@@ -716,16 +957,22 @@ _PUBLIC_ enum mapistore_error mapistore_folder_create_message(struct mapistore_c
 							      void *folder, TALLOC_CTX *mem_ctx, uint64_t mid, uint8_t associated, void **messagep)
 {
 	struct backend_context		*backend_ctx;
+	enum mapistore_error		ret;
+	struct oc_trace_span		span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	
 	/* Step 2. Call backend create_message */
-	return mapistore_backend_folder_create_message(backend_ctx, folder, mem_ctx, mid, associated, messagep);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_create_message(backend_ctx, folder, mem_ctx, mid, associated, messagep);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 /**
@@ -744,16 +991,22 @@ _PUBLIC_ enum mapistore_error mapistore_folder_delete_message(struct mapistore_c
 							      void *folder, uint64_t mid, uint8_t flags)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_folder_delete_message(backend_ctx, folder, mid, flags);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_delete_message(backend_ctx, folder, mid, flags);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 /**
@@ -772,7 +1025,7 @@ _PUBLIC_ enum mapistore_error mapistore_folder_move_copy_messages(struct mapisto
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -803,7 +1056,7 @@ _PUBLIC_ enum mapistore_error mapistore_folder_move_folder(struct mapistore_cont
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -823,7 +1076,7 @@ _PUBLIC_ enum mapistore_error mapistore_folder_copy_folder(struct mapistore_cont
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -853,13 +1106,50 @@ _PUBLIC_ enum mapistore_error mapistore_folder_get_deleted_fmids(struct mapistor
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
 	return mapistore_backend_folder_get_deleted_fmids(backend_ctx, folder, mem_ctx, table_type, change_num, fmidsp, cnp);
 }
 
+/**
+   \details Get the array of items modified or created after a specific
+   change number
+
+   Backends implementing this operation keep a per-folder index ordered
+   by change number, so the lookup is a range scan over the entries
+   newer than change_num rather than a walk of the whole content
+   table. Callers fall back to the content table when the backend
+   returns MAPISTORE_ERR_NOT_IMPLEMENTED.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param folder the folder backend object
+   \param mem_ctx the TALLOC_CTX that should be used as parent for the returned array
+   \param table_type the type of object that we want to take into account
+   \param change_num the reference change number
+   \param fmidsp a pointer to the returned array, sorted by ascending
+   change number
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE errors
+ */
+_PUBLIC_ enum mapistore_error mapistore_folder_get_changed_fmids(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, TALLOC_CTX *mem_ctx, enum mapistore_table_type table_type, uint64_t change_num, struct UI8Array_r **fmidsp)
+{
+	struct backend_context	*backend_ctx;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!fmidsp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	return mapistore_backend_folder_get_changed_fmids(backend_ctx, folder, mem_ctx, table_type, change_num, fmidsp);
+}
+
 /**
    \details Retrieve the number of child messages within a mapistore folder
 
@@ -873,6 +1163,8 @@ _PUBLIC_ enum mapistore_error mapistore_folder_get_deleted_fmids(struct mapistor
 _PUBLIC_ enum mapistore_error mapistore_folder_get_child_count(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, enum mapistore_table_type table_type, uint32_t *RowCount)
 {
 	struct backend_context		*backend_ctx;
+	enum mapistore_error		ret;
+	struct oc_trace_span		span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
@@ -880,11 +1172,15 @@ _PUBLIC_ enum mapistore_error mapistore_folder_get_child_count(struct mapistore_
 	MAPISTORE_RETVAL_IF(!RowCount, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 0. Ensure the context exists */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend get_child_count */
-	return mapistore_backend_folder_get_child_count(backend_ctx, folder, table_type, RowCount);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_get_child_count(backend_ctx, folder, table_type, RowCount);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 /**
@@ -967,7 +1263,7 @@ _PUBLIC_ enum mapistore_error mapistore_folder_get_child_fid_by_name(struct mapi
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -978,16 +1274,22 @@ _PUBLIC_ enum mapistore_error mapistore_folder_open_table(struct mapistore_conte
 							  void *folder, TALLOC_CTX *mem_ctx, enum mapistore_table_type table_type, uint32_t handle_id, void **table, uint32_t *row_count)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_folder_open_table(backend_ctx, folder, mem_ctx, table_type, handle_id, table, row_count);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_open_table(backend_ctx, folder, mem_ctx, table_type, handle_id, table, row_count);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_folder_modify_permissions(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, uint8_t flags, uint16_t pcount, struct PermissionData *permissions)
@@ -998,7 +1300,7 @@ _PUBLIC_ enum mapistore_error mapistore_folder_modify_permissions(struct mapisto
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1013,13 +1315,132 @@ _PUBLIC_ enum mapistore_error mapistore_folder_preload_message_bodies(struct map
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
 	return mapistore_backend_folder_preload_message_bodies(backend_ctx, folder, table_type, mids);
 }
 
+/**
+   \details Change the read flag of a set of messages of a folder
+
+   Backends implementing the optional set_read_flags operation update
+   all the messages at once. Otherwise each message is opened and its
+   read flag changed in turn. Messages that do not exist are skipped.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param folder pointer to the folder object
+   \param mid_count the number of messages
+   \param mids the message identifiers
+   \param flag the read flag operation to apply, as for
+   mapistore_message_set_read_flag
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE errors
+ */
+_PUBLIC_ enum mapistore_error mapistore_folder_set_read_flags(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder,
+							      uint32_t mid_count, const uint64_t *mids, uint8_t flag)
+{
+	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
+	TALLOC_CTX		*mem_ctx;
+	void			*message;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(mid_count && !mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!mid_count, MAPISTORE_SUCCESS, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_set_read_flags(backend_ctx, folder, mid_count, mids, flag);
+	if (ret != MAPISTORE_ERR_NOT_IMPLEMENTED) {
+		oc_trace_span_end(&span, ret);
+		return ret;
+	}
+
+	/* Step 3. Fall back on one message at a time */
+	ret = MAPISTORE_SUCCESS;
+	for (i = 0; i < mid_count && ret == MAPISTORE_SUCCESS; i++) {
+		mem_ctx = talloc_new(NULL);
+		if (!mem_ctx) {
+			ret = MAPISTORE_ERR_NO_MEMORY;
+			break;
+		}
+		ret = mapistore_backend_folder_open_message(backend_ctx, folder, mem_ctx, mids[i], true, &message);
+		if (ret == MAPISTORE_SUCCESS) {
+			ret = mapistore_backend_message_set_read_flag(backend_ctx, message, flag);
+		} else if (ret == MAPISTORE_ERR_NOT_FOUND) {
+			ret = MAPISTORE_SUCCESS;
+		}
+		talloc_free(mem_ctx);
+	}
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
+/**
+   \details Delete a set of messages of a folder
+
+   Backends implementing the optional delete_messages operation
+   delete all the messages at once. Otherwise they are deleted one by
+   one. Messages that do not exist are skipped.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param folder pointer to the folder object
+   \param mid_count the number of messages
+   \param mids the message identifiers
+   \param flags MAPISTORE_SOFT_DELETE or MAPISTORE_PERMANENT_DELETE
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE errors
+ */
+_PUBLIC_ enum mapistore_error mapistore_folder_delete_messages(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder,
+							       uint32_t mid_count, const uint64_t *mids, uint8_t flags)
+{
+	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
+	uint32_t		i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(mid_count && !mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!mid_count, MAPISTORE_SUCCESS, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_folder_delete_messages(backend_ctx, folder, mid_count, mids, flags);
+	if (ret != MAPISTORE_ERR_NOT_IMPLEMENTED) {
+		oc_trace_span_end(&span, ret);
+		return ret;
+	}
+
+	/* Step 3. Fall back on one message at a time */
+	ret = MAPISTORE_SUCCESS;
+	for (i = 0; i < mid_count && ret == MAPISTORE_SUCCESS; i++) {
+		ret = mapistore_backend_folder_delete_message(backend_ctx, folder, mids[i], flags);
+		if (ret == MAPISTORE_ERR_NOT_FOUND) {
+			ret = MAPISTORE_SUCCESS;
+		}
+	}
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
 /* freebusy helper */
 static int mapistore_days_in_month(int month, int year)
 {
@@ -1148,8 +1569,49 @@ static uint16_t mapistore_freebusy_find_month_range(uint32_t ymon, uint32_t *mon
 	return (uint16_t) -1;
 }
 
-/* TODO: both following methods could be merged. This would certainly enhance performance by avoiding to wander through long arrays multiple times */
-static void mapistore_freebusy_fill_fbarray(uint8_t **minutes_array, uint32_t *months_ranges, uint16_t nbr_months, struct FILETIME *start, struct FILETIME *end)
+static const int	max_mins_per_month = 31 * 24 * 60;
+
+/* Free/busy months are packed bitmaps: one bit per minute, 64 minutes per word */
+#define	FREEBUSY_WORD_BITS	64
+#define	FREEBUSY_WORDS_PER_MONTH	((31 * 24 * 60 + FREEBUSY_WORD_BITS - 1) / FREEBUSY_WORD_BITS)
+
+/**
+   \details Mark the minutes [start, end) as used in a month bitmap
+
+   \param bitmap pointer to the month bitmap
+   \param start first minute of the range
+   \param end minute following the last minute of the range
+ */
+static void mapistore_freebusy_set_bits(uint64_t *bitmap, uint32_t start, uint32_t end)
+{
+	uint32_t	start_word, end_word, i;
+	uint64_t	head_mask, tail_mask;
+
+	if (end > max_mins_per_month) {
+		end = max_mins_per_month;
+	}
+	if (start >= end) {
+		return;
+	}
+
+	start_word = start / FREEBUSY_WORD_BITS;
+	end_word = (end - 1) / FREEBUSY_WORD_BITS;
+	head_mask = ~0ULL << (start % FREEBUSY_WORD_BITS);
+	tail_mask = ~0ULL >> (FREEBUSY_WORD_BITS - 1 - ((end - 1) % FREEBUSY_WORD_BITS));
+
+	if (start_word == end_word) {
+		bitmap[start_word] |= (head_mask & tail_mask);
+		return;
+	}
+
+	bitmap[start_word] |= head_mask;
+	for (i = start_word + 1; i < end_word; i++) {
+		bitmap[i] = ~0ULL;
+	}
+	bitmap[end_word] |= tail_mask;
+}
+
+static void mapistore_freebusy_fill_fbarray(uint64_t **bitmaps, uint32_t *months_ranges, uint16_t nbr_months, struct FILETIME *start, struct FILETIME *end)
 {
 	uint32_t	i, max, start_ymon, start_mins, end_ymon, end_mins;
 	uint16_t	start_mr_idx, end_mr_idx;
@@ -1173,11 +1635,11 @@ static void mapistore_freebusy_fill_fbarray(uint8_t **minutes_array, uint32_t *m
 
 		/* middle */
 		for (i = start_mr_idx + 1; i < end_mr_idx; i++) {
-			memset(minutes_array[i], 1, mapistore_mins_in_ymon(months_ranges[i]));
+			mapistore_freebusy_set_bits(bitmaps[i], 0, mapistore_mins_in_ymon(months_ranges[i]));
 		}
 
 		/* tail */
-		memset(minutes_array[end_mr_idx], 1, end_mins);
+		mapistore_freebusy_set_bits(bitmaps[end_mr_idx], 0, end_mins);
 
 		max = mapistore_mins_in_ymon(start_ymon); /* = max chunk for first range */
 	}
@@ -1186,14 +1648,25 @@ static void mapistore_freebusy_fill_fbarray(uint8_t **minutes_array, uint32_t *m
 
 		max = end_mins;
 	}
-	memset(minutes_array[start_mr_idx] + start_mins, 1, (max - start_mins));
+	mapistore_freebusy_set_bits(bitmaps[start_mr_idx], start_mins, max);
 }
 
-static const int	max_mins_per_month = 31 * 24 * 60;
+/**
+   \details Encode a month bitmap into the list of ranges expected in
+   the free/busy binary properties
 
-static void mapistore_freebusy_compile_fbarray(TALLOC_CTX *mem_ctx, uint8_t *minutes_array, struct Binary_r *fb_bin)
+   Runs of used minutes are pushed as (first minute, last minute) pairs.
+   Words that are entirely free or entirely used are skipped without
+   looking at individual bits.
+
+   \param mem_ctx pointer to the memory context
+   \param bitmap pointer to the month bitmap
+   \param fb_bin pointer to the Binary_r to fill
+ */
+static void mapistore_freebusy_compile_fbarray(TALLOC_CTX *mem_ctx, const uint64_t *bitmap, struct Binary_r *fb_bin)
 {
-	int			i;
+	uint32_t		i, bit, minute;
+	uint64_t		word;
 	bool			filled;
 	struct ndr_push		*ndr;
 	TALLOC_CTX		*local_mem_ctx;
@@ -1202,19 +1675,25 @@ static void mapistore_freebusy_compile_fbarray(TALLOC_CTX *mem_ctx, uint8_t *min
 
 	ndr = ndr_push_init_ctx(local_mem_ctx);
 
-	filled = (minutes_array[0] != 0);
-	if (filled) {
-		ndr_push_uint16(ndr, NDR_SCALARS, 0);
-	}
-
-	for (i = 1; i < max_mins_per_month; i++) {
-		if (filled && !minutes_array[i]) {
-			ndr_push_uint16(ndr, NDR_SCALARS, (i - 1));
-			filled = false;
+	filled = false;
+	for (i = 0; i < FREEBUSY_WORDS_PER_MONTH; i++) {
+		word = bitmap[i];
+		if ((filled && word == ~0ULL) || (!filled && word == 0)) {
+			continue;
 		}
-		else if (!filled && minutes_array[i]) {
-			ndr_push_uint16(ndr, NDR_SCALARS, i);
-			filled = true;
+		for (bit = 0; bit < FREEBUSY_WORD_BITS; bit++) {
+			minute = i * FREEBUSY_WORD_BITS + bit;
+			if (minute >= max_mins_per_month) {
+				break;
+			}
+			if (filled && !(word & (1ULL << bit))) {
+				ndr_push_uint16(ndr, NDR_SCALARS, (minute - 1));
+				filled = false;
+			}
+			else if (!filled && (word & (1ULL << bit))) {
+				ndr_push_uint16(ndr, NDR_SCALARS, minute);
+				filled = true;
+			}
 		}
 	}
 	if (filled) {
@@ -1228,53 +1707,32 @@ static void mapistore_freebusy_compile_fbarray(TALLOC_CTX *mem_ctx, uint8_t *min
 	talloc_free(local_mem_ctx);
 }
 
-static void mapistore_freebusy_merge_subarray(uint8_t *minutes_array, uint8_t *included_array)
+static void mapistore_freebusy_merge_subarray(uint64_t *bitmap, const uint64_t *included_bitmap)
 {
 	int i;
 
-	for (i = 0; i < max_mins_per_month; i++) {
-		if (included_array[i]) {
-			minutes_array[i] = 1;
-		}
+	for (i = 0; i < FREEBUSY_WORDS_PER_MONTH; i++) {
+		bitmap[i] |= included_bitmap[i];
 	}
 }
 
-enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, struct tm *start_tm, struct tm *end_tm, TALLOC_CTX *mem_ctx, struct mapistore_freebusy_properties **fb_props_p)
+/**
+   \details Compute the publishing range and months of a free/busy request
+
+   \param fb_props pointer to the free/busy properties to initialize
+   \param start_tm start of the range, or NULL for the default range
+   \param end_tm end of the range, or NULL for the default range
+   \param start_nt pointer to the returned start of the range
+   \param end_nt pointer to the returned end of the range
+ */
+static void mapistore_freebusy_setup_range(struct mapistore_freebusy_properties *fb_props, struct tm *start_tm, struct tm *end_tm, NTTIME *start_nt, NTTIME *end_nt)
 {
-	enum mapistore_error			ret;
-	struct mapistore_freebusy_properties	*fb_props;
-	struct backend_context			*backend_ctx;
-	TALLOC_CTX				*local_mem_ctx;
-	void					*table;
-	uint32_t				row_count;
-	struct SPropTagArray			*props;
-	struct mapistore_property_data		*row_data;
-	struct mapi_SRestriction		and_res;
-	uint8_t					state;
 	struct tm				local_start_tm, local_end_tm;
 	time_t					start_time, end_time;
 	NTTIME					nt_time;
-	struct mapi_SRestriction_and		time_restrictions[2];
 	int					i, month, nbr_months;
-	uint8_t					**minutes_array, **free_array, **tentative_array, **busy_array, **oof_array;
 	char					*tz;
 
-	/* Sanity checks */
-	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
-
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
-	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
-
-	local_mem_ctx = talloc_zero(NULL, TALLOC_CTX);
-
-	/* fetch events from this month for 3 months: start + enddate + fbstatus */
-	ret = mapistore_folder_open_table(mstore_ctx, context_id, folder, local_mem_ctx, MAPISTORE_MESSAGE_TABLE, 0, &table, &row_count);
-	if (ret != MAPISTORE_SUCCESS) {
-		goto end;
-	}
-
-	fb_props = talloc_zero(local_mem_ctx, struct mapistore_freebusy_properties);
-
 	/* fetch freebusy range */
 	if (start_tm && end_tm) {
 		local_start_tm = *start_tm;
@@ -1301,39 +1759,10 @@ enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore
 	}
 	tzset();
 
-	/* setup restriction */
-	and_res.rt = RES_AND;
-	and_res.res.resAnd.cRes = 2;
-	and_res.res.resAnd.res = time_restrictions;
-
-	time_restrictions[0].rt = RES_PROPERTY;
-	time_restrictions[0].res.resProperty.relop = RELOP_GE;
-	time_restrictions[0].res.resProperty.ulPropTag = PidLidAppointmentEndWhole; 
-	time_restrictions[0].res.resProperty.lpProp.ulPropTag = PidLidAppointmentEndWhole;
-	unix_to_nt_time(&nt_time, start_time);
-	time_restrictions[0].res.resProperty.lpProp.value.ft.dwLowDateTime = (nt_time & 0xffffffff);
-	time_restrictions[0].res.resProperty.lpProp.value.ft.dwHighDateTime = nt_time >> 32;
-	fb_props->publish_start = (uint32_t) (nt_time / (60 * 10000000));
-
-	time_restrictions[1].rt = RES_PROPERTY;
-	time_restrictions[1].res.resProperty.relop = RELOP_LE;
-	time_restrictions[1].res.resProperty.ulPropTag = PidLidAppointmentStartWhole; 
-	time_restrictions[1].res.resProperty.lpProp.ulPropTag = PidLidAppointmentStartWhole;
-	unix_to_nt_time(&nt_time, end_time);
-	time_restrictions[1].res.resProperty.lpProp.value.ft.dwLowDateTime = (nt_time & 0xffffffff);
-	time_restrictions[1].res.resProperty.lpProp.value.ft.dwHighDateTime = nt_time >> 32;
-	fb_props->publish_end = (uint32_t) (nt_time / (60 * 10000000));
-
-	mapistore_table_set_restrictions(mstore_ctx, context_id, table, &and_res, &state);
-
-	/* setup table columns */
-	props = talloc_zero(local_mem_ctx, struct SPropTagArray);
-	props->cValues = 3;
-	props->aulPropTag = talloc_array(props, enum MAPITAGS, props->cValues);
-	props->aulPropTag[0] = PidLidAppointmentStartWhole;
-	props->aulPropTag[1] = PidLidAppointmentEndWhole;
-	props->aulPropTag[2] = PidLidBusyStatus;
-	mapistore_table_set_columns(mstore_ctx, context_id, table, props->cValues, props->aulPropTag);
+	unix_to_nt_time(start_nt, start_time);
+	fb_props->publish_start = (uint32_t) (*start_nt / (60 * 10000000));
+	unix_to_nt_time(end_nt, end_time);
+	fb_props->publish_end = (uint32_t) (*end_nt / (60 * 10000000));
 
 	/* setup months arrays */
 	if (local_start_tm.tm_year == local_end_tm.tm_year) {
@@ -1342,6 +1771,7 @@ enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore
 	else {
 		nbr_months = (12 - local_start_tm.tm_mon) + local_end_tm.tm_mon + 1;
 	}
+	fb_props->nbr_months = nbr_months;
 	fb_props->months_ranges = talloc_array(fb_props, uint32_t, nbr_months);
 	if (local_start_tm.tm_year == local_end_tm.tm_year) {
 		for (i = 0; i < nbr_months; i++) {
@@ -1364,51 +1794,158 @@ enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore
 		}
 		fb_props->months_ranges[i] = ((local_end_tm.tm_year + 1900) << 4) + month + 1;
 	}
+}
 
-	/* fetch events and fill freebusy arrays */
-	free_array = talloc_array(local_mem_ctx, uint8_t *, nbr_months);
-	tentative_array = talloc_array(local_mem_ctx, uint8_t *, nbr_months);
-	busy_array = talloc_array(local_mem_ctx, uint8_t *, nbr_months);
-	oof_array = talloc_array(local_mem_ctx, uint8_t *, nbr_months);
-	for (i = 0; i < nbr_months; i++) {
-		free_array[i] = talloc_array(free_array, uint8_t, max_mins_per_month);
-		memset(free_array[i], 0, max_mins_per_month);
-		tentative_array[i] = talloc_array(tentative_array, uint8_t, max_mins_per_month);
-		memset(tentative_array[i], 0, max_mins_per_month);
-		busy_array[i] = talloc_array(tentative_array, uint8_t, max_mins_per_month);
-		memset(busy_array[i], 0, max_mins_per_month);
-		oof_array[i] = talloc_array(tentative_array, uint8_t, max_mins_per_month);
-		memset(oof_array[i], 0, max_mins_per_month);
-	}
+/**
+   \details Scan a calendar for the appointments overlapping a range
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param folder the calendar backend object
+   \param mem_ctx pointer to the memory context for the returned events
+   \param start_nt start of the range
+   \param end_nt end of the range
+   \param events_p pointer to the returned array of events
+   \param count_p pointer to the returned number of events
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_freebusy_scan_events(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, TALLOC_CTX *mem_ctx, NTTIME start_nt, NTTIME end_nt, struct mapistore_freebusy_event **events_p, uint32_t *count_p)
+{
+	enum mapistore_error			ret;
+	TALLOC_CTX				*local_mem_ctx;
+	void					*table;
+	uint32_t				row_count, count;
+	struct SPropTagArray			*props;
+	struct mapistore_property_data		*row_data;
+	struct mapi_SRestriction		and_res;
+	uint8_t					state;
+	struct mapi_SRestriction_and		time_restrictions[2];
+	struct mapistore_freebusy_event		*events;
+	int					i;
+
+	local_mem_ctx = talloc_zero(NULL, TALLOC_CTX);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* fetch events from this month for 3 months: start + enddate + fbstatus */
+	ret = mapistore_folder_open_table(mstore_ctx, context_id, folder, local_mem_ctx, MAPISTORE_MESSAGE_TABLE, 0, &table, &row_count);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
+
+	/* setup restriction */
+	and_res.rt = RES_AND;
+	and_res.res.resAnd.cRes = 2;
+	and_res.res.resAnd.res = time_restrictions;
+
+	time_restrictions[0].rt = RES_PROPERTY;
+	time_restrictions[0].res.resProperty.relop = RELOP_GE;
+	time_restrictions[0].res.resProperty.ulPropTag = PidLidAppointmentEndWhole; 
+	time_restrictions[0].res.resProperty.lpProp.ulPropTag = PidLidAppointmentEndWhole;
+	time_restrictions[0].res.resProperty.lpProp.value.ft.dwLowDateTime = (start_nt & 0xffffffff);
+	time_restrictions[0].res.resProperty.lpProp.value.ft.dwHighDateTime = start_nt >> 32;
+
+	time_restrictions[1].rt = RES_PROPERTY;
+	time_restrictions[1].res.resProperty.relop = RELOP_LE;
+	time_restrictions[1].res.resProperty.ulPropTag = PidLidAppointmentStartWhole; 
+	time_restrictions[1].res.resProperty.lpProp.ulPropTag = PidLidAppointmentStartWhole;
+	time_restrictions[1].res.resProperty.lpProp.value.ft.dwLowDateTime = (end_nt & 0xffffffff);
+	time_restrictions[1].res.resProperty.lpProp.value.ft.dwHighDateTime = end_nt >> 32;
+
+	mapistore_table_set_restrictions(mstore_ctx, context_id, table, &and_res, &state);
+
+	/* setup table columns */
+	props = talloc_zero(local_mem_ctx, struct SPropTagArray);
+	props->cValues = 4;
+	props->aulPropTag = talloc_array(props, enum MAPITAGS, props->cValues);
+	props->aulPropTag[0] = PidLidAppointmentStartWhole;
+	props->aulPropTag[1] = PidLidAppointmentEndWhole;
+	props->aulPropTag[2] = PidLidBusyStatus;
+	props->aulPropTag[3] = PR_MID;
+	mapistore_table_set_columns(mstore_ctx, context_id, table, props->cValues, props->aulPropTag);
+
+	events = talloc_array(mem_ctx, struct mapistore_freebusy_event, row_count);
+	MAPISTORE_RETVAL_IF(row_count && !events, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
 
 	i = 0;
+	count = 0;
 	while (mapistore_table_get_row(mstore_ctx, context_id, table, local_mem_ctx, MAPISTORE_PREFILTERED_QUERY, i, &row_data) == MAPISTORE_SUCCESS) {
 		if (row_data[0].error == MAPISTORE_SUCCESS && row_data[1].error == MAPISTORE_SUCCESS && row_data[2].error == MAPISTORE_SUCCESS) {
-			switch (*((uint32_t *) row_data[2].data)) {
-			case olFree:
-				minutes_array = free_array;
-				break;
-			case olTentative:
-				minutes_array = tentative_array;
-				break;
-			case olBusy:
-				minutes_array = busy_array;
-				break;
-			case olOutOfOffice:
-				minutes_array = oof_array;
-				break;
-			default:
-				minutes_array = NULL;
-			}
-			if (minutes_array) {
-				mapistore_freebusy_fill_fbarray(minutes_array, fb_props->months_ranges, nbr_months, row_data[0].data, row_data[1].data);
+			if (count == row_count) {
+				/* the backend returned more rows than announced */
+				events = talloc_realloc(mem_ctx, events, struct mapistore_freebusy_event, count + 1);
+				MAPISTORE_RETVAL_IF(!events, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+				row_count++;
 			}
+			events[count].mid = (row_data[3].error == MAPISTORE_SUCCESS) ? *((uint64_t *) row_data[3].data) : 0;
+			events[count].start = *((struct FILETIME *) row_data[0].data);
+			events[count].end = *((struct FILETIME *) row_data[1].data);
+			events[count].busy_status = *((uint32_t *) row_data[2].data);
+			count++;
 		}
 		i++;
 	}
 
-        /* compile minutes array into arrays of ranges */
-	fb_props->nbr_months = nbr_months;
+	*events_p = events;
+	*count_p = count;
+
+	talloc_free(local_mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Build the free/busy binary properties from a list of events
+
+   \param fb_props pointer to the free/busy properties, with the range
+   already set up
+   \param events array of events
+   \param count number of events
+ */
+static void mapistore_freebusy_compile_events(struct mapistore_freebusy_properties *fb_props, const struct mapistore_freebusy_event *events, uint32_t count)
+{
+	TALLOC_CTX				*local_mem_ctx;
+	uint64_t				**bitmaps, **free_array, **tentative_array, **busy_array, **oof_array;
+	uint16_t				nbr_months = fb_props->nbr_months;
+	uint32_t				i;
+
+	local_mem_ctx = talloc_zero(NULL, TALLOC_CTX);
+
+	/* fill freebusy arrays */
+	free_array = talloc_array(local_mem_ctx, uint64_t *, nbr_months);
+	tentative_array = talloc_array(local_mem_ctx, uint64_t *, nbr_months);
+	busy_array = talloc_array(local_mem_ctx, uint64_t *, nbr_months);
+	oof_array = talloc_array(local_mem_ctx, uint64_t *, nbr_months);
+	for (i = 0; i < nbr_months; i++) {
+		free_array[i] = talloc_zero_array(free_array, uint64_t, FREEBUSY_WORDS_PER_MONTH);
+		tentative_array[i] = talloc_zero_array(tentative_array, uint64_t, FREEBUSY_WORDS_PER_MONTH);
+		busy_array[i] = talloc_zero_array(busy_array, uint64_t, FREEBUSY_WORDS_PER_MONTH);
+		oof_array[i] = talloc_zero_array(oof_array, uint64_t, FREEBUSY_WORDS_PER_MONTH);
+	}
+
+	for (i = 0; i < count; i++) {
+		switch (events[i].busy_status) {
+		case olFree:
+			bitmaps = free_array;
+			break;
+		case olTentative:
+			bitmaps = tentative_array;
+			break;
+		case olBusy:
+			bitmaps = busy_array;
+			break;
+		case olOutOfOffice:
+			bitmaps = oof_array;
+			break;
+		default:
+			bitmaps = NULL;
+		}
+		if (bitmaps) {
+			mapistore_freebusy_fill_fbarray(bitmaps, fb_props->months_ranges, nbr_months,
+							discard_const_p(struct FILETIME, &events[i].start),
+							discard_const_p(struct FILETIME, &events[i].end));
+		}
+	}
+
+	/* compile month bitmaps into arrays of ranges */
 	fb_props->freebusy_free = talloc_array(fb_props, struct Binary_r, nbr_months);
 	fb_props->freebusy_tentative = talloc_array(fb_props, struct Binary_r, nbr_months);
 	fb_props->freebusy_busy = talloc_array(fb_props, struct Binary_r, nbr_months);
@@ -1423,6 +1960,37 @@ enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore
 		mapistore_freebusy_compile_fbarray(fb_props, busy_array[i], fb_props->freebusy_merged + i);
 	}
 
+	talloc_free(local_mem_ctx);
+}
+
+enum mapistore_error mapistore_folder_fetch_freebusy_properties(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, struct tm *start_tm, struct tm *end_tm, TALLOC_CTX *mem_ctx, struct mapistore_freebusy_properties **fb_props_p)
+{
+	enum mapistore_error			ret;
+	struct mapistore_freebusy_properties	*fb_props;
+	struct backend_context			*backend_ctx;
+	TALLOC_CTX				*local_mem_ctx;
+	struct mapistore_freebusy_event		*events;
+	uint32_t				count;
+	NTTIME					start_nt, end_nt;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_zero(NULL, TALLOC_CTX);
+
+	fb_props = talloc_zero(local_mem_ctx, struct mapistore_freebusy_properties);
+	mapistore_freebusy_setup_range(fb_props, start_tm, end_tm, &start_nt, &end_nt);
+
+	ret = mapistore_freebusy_scan_events(mstore_ctx, context_id, folder, local_mem_ctx, start_nt, end_nt, &events, &count);
+	if (ret != MAPISTORE_SUCCESS) {
+		goto end;
+	}
+
+	mapistore_freebusy_compile_events(fb_props, events, count);
+
 	*fb_props_p = fb_props;
 
 	/* we bind fb_props to mem_ctx, because it will be released with the local_mem_ctx */
@@ -1436,6 +2004,69 @@ end:
 	return ret;
 }
 
+/**
+   \details Fetch the free/busy properties of a calendar for the default
+   publishing range, using the persisted summary of the calendar
+
+   The calendar is only scanned when it has no valid summary, the
+   summary is then stored for the next requests.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param folder the calendar backend object
+   \param username the calendar owner
+   \param fid the calendar folder identifier
+   \param mem_ctx pointer to the memory context
+   \param fb_props_p pointer to the returned free/busy properties
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_folder_fetch_freebusy_summary(struct mapistore_context *mstore_ctx, uint32_t context_id, void *folder, const char *username, uint64_t fid, TALLOC_CTX *mem_ctx, struct mapistore_freebusy_properties **fb_props_p)
+{
+	enum mapistore_error			ret;
+	struct mapistore_freebusy_properties	*fb_props;
+	struct backend_context			*backend_ctx;
+	TALLOC_CTX				*local_mem_ctx;
+	struct mapistore_freebusy_event		*events;
+	uint32_t				count;
+	NTTIME					start_nt, end_nt;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!fb_props_p, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_zero(NULL, TALLOC_CTX);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	fb_props = talloc_zero(local_mem_ctx, struct mapistore_freebusy_properties);
+	MAPISTORE_RETVAL_IF(!fb_props, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+	mapistore_freebusy_setup_range(fb_props, NULL, NULL, &start_nt, &end_nt);
+
+	ret = mapistore_freebusy_summary_load(local_mem_ctx, username, fid, fb_props->publish_start,
+					      fb_props->publish_end, &events, &count);
+	if (ret != MAPISTORE_SUCCESS) {
+		ret = mapistore_freebusy_scan_events(mstore_ctx, context_id, folder, local_mem_ctx, start_nt, end_nt, &events, &count);
+		MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
+
+		ret = mapistore_freebusy_summary_store(username, fid, fb_props->publish_start,
+						       fb_props->publish_end, events, count);
+		if (ret != MAPISTORE_SUCCESS) {
+			OC_DEBUG(3, "Unable to store free/busy summary of 0x%.16"PRIx64": %s", fid, mapistore_errstr(ret));
+		}
+	}
+
+	mapistore_freebusy_compile_events(fb_props, events, count);
+
+	*fb_props_p = talloc_steal(mem_ctx, fb_props);
+	talloc_free(local_mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
 /**
    \details Modify recipients of a message in mapistore
 
@@ -1456,7 +2087,7 @@ enum mapistore_error mapistore_message_get_message_data(struct mapistore_context
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend modifyrecipients */
@@ -1483,7 +2114,7 @@ enum mapistore_error mapistore_message_modify_recipients(struct mapistore_contex
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend modifyrecipients */
@@ -1509,7 +2140,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_set_read_flag(struct mapistore_c
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend savechangesmessage */
@@ -1530,16 +2161,22 @@ _PUBLIC_ enum mapistore_error mapistore_message_set_read_flag(struct mapistore_c
 _PUBLIC_ enum mapistore_error mapistore_message_save(struct mapistore_context *mstore_ctx, uint32_t context_id, void *message, TALLOC_CTX *mem_ctx)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend savechangesmessage */
-	return mapistore_backend_message_save(backend_ctx, message, mem_ctx);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_message_save(backend_ctx, message, mem_ctx);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 
@@ -1563,7 +2200,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_submit(struct mapistore_context
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend submitmessage */
@@ -1579,7 +2216,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_get_attachment_table(struct mapi
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1595,7 +2232,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_open_attachment(struct mapistore
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1611,7 +2248,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_create_attachment(struct mapisto
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1626,7 +2263,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_attachment_open_embedded_message
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1641,7 +2278,7 @@ _PUBLIC_ enum mapistore_error mapistore_message_attachment_create_embedded_messa
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1656,7 +2293,7 @@ _PUBLIC_ enum mapistore_error mapistore_table_get_available_properties(struct ma
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1666,77 +2303,188 @@ _PUBLIC_ enum mapistore_error mapistore_table_get_available_properties(struct ma
 _PUBLIC_ enum mapistore_error mapistore_table_set_columns(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, uint16_t count, enum MAPITAGS *properties)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_table_set_columns(backend_ctx, table, count, properties);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_table_set_columns(backend_ctx, table, count, properties);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_table_set_restrictions(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, struct mapi_SRestriction *restrictions, uint8_t *table_status)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_table_set_restrictions(backend_ctx, table, restrictions, table_status);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_table_set_restrictions(backend_ctx, table, restrictions, table_status);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_table_set_sort_order(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, struct SSortOrderSet *sort_order, uint8_t *table_status)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_table_set_sort_order(backend_ctx, table, sort_order, table_status);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_table_set_sort_order(backend_ctx, table, sort_order, table_status);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_table_get_row(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, TALLOC_CTX *mem_ctx,
 						      enum mapistore_query_type query_type, uint32_t rowid, struct mapistore_property_data **data)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_table_get_row(backend_ctx, table, mem_ctx, query_type, rowid, data);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_table_get_row(backend_ctx, table, mem_ctx, query_type, rowid, data);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
+/* Fetch a range of rows with the single row operation of the backend */
+static enum mapistore_error mapistore_table_get_rows_by_row(struct backend_context *backend_ctx, void *table, TALLOC_CTX *mem_ctx,
+							    enum mapistore_query_type query_type, uint32_t start, uint32_t count,
+							    struct mapistore_property_data ***rowsp, uint32_t *fetchedp)
+{
+	struct mapistore_property_data	**rows;
+	enum mapistore_error		ret;
+	uint32_t			i;
+
+	rows = talloc_array(mem_ctx, struct mapistore_property_data *, count);
+	MAPISTORE_RETVAL_IF(!rows, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (i = 0; i < count; i++) {
+		ret = mapistore_backend_table_get_row(backend_ctx, table, rows, query_type, start + i, &rows[i]);
+		if (ret != MAPISTORE_SUCCESS) {
+			break;
+		}
+	}
+	MAPISTORE_RETVAL_IF(i == 0, ret, rows);
+
+	*rowsp = rows;
+	*fetchedp = i;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Fetch a range of consecutive rows from a table
+
+   Backends implementing the optional get_rows operation return the
+   whole range in a single call. For the others, rows are fetched one
+   by one with get_row.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param table pointer to the backend table object
+   \param mem_ctx pointer to the memory context
+   \param query_type the type of query to perform
+   \param start the position of the first row to fetch
+   \param count the number of rows to fetch
+   \param rowsp pointer to the returned array of rows, each being the
+   property array get_row would return
+   \param fetchedp pointer to the number of rows actually fetched, which
+   is lower than count if the end of the table or an invalid row was
+   reached
+
+   \return MAPISTORE_SUCCESS if at least one row was fetched, otherwise
+   MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_table_get_rows(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, TALLOC_CTX *mem_ctx,
+						       enum mapistore_query_type query_type, uint32_t start, uint32_t count,
+						       struct mapistore_property_data ***rowsp, uint32_t *fetchedp)
+{
+	struct backend_context		*backend_ctx;
+	enum mapistore_error		ret;
+	struct oc_trace_span		span;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!rowsp || !fetchedp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!count, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+
+	/* Step 2. Call backend bulk operation if available */
+	ret = mapistore_backend_table_get_rows(backend_ctx, table, mem_ctx, query_type, start, count, rowsp, fetchedp);
+
+	/* Step 3. Fall back on the single row operation */
+	if (ret == MAPISTORE_ERR_NOT_IMPLEMENTED) {
+		ret = mapistore_table_get_rows_by_row(backend_ctx, table, mem_ctx, query_type, start, count, rowsp, fetchedp);
+	}
+
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_table_get_row_count(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, enum mapistore_query_type query_type, uint32_t *row_countp)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_table_get_row_count(backend_ctx, table, query_type, row_countp);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_table_get_row_count(backend_ctx, table, query_type, row_countp);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_table_handle_destructor(struct mapistore_context *mstore_ctx, uint32_t context_id, void *table, uint32_t handle_id)
@@ -1747,7 +2495,7 @@ _PUBLIC_ enum mapistore_error mapistore_table_handle_destructor(struct mapistore
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1762,7 +2510,7 @@ _PUBLIC_ enum mapistore_error mapistore_properties_get_available_properties(stru
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
@@ -1776,16 +2524,22 @@ _PUBLIC_ enum mapistore_error mapistore_properties_get_properties(struct mapisto
 								  struct mapistore_property_data *data)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_properties_get_properties(backend_ctx, object, mem_ctx, count, properties, data);
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_properties_get_properties(backend_ctx, object, mem_ctx, count, properties, data);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
 }
 
 _PUBLIC_ enum mapistore_error mapistore_properties_set_properties(struct mapistore_context
@@ -1794,16 +2548,197 @@ _PUBLIC_ enum mapistore_error mapistore_properties_set_properties(struct mapisto
 								  struct SRow *aRow)
 {
 	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_properties_set_properties(backend_ctx, object, aRow);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
+/**
+   \details Open a property of a mapistore object as a stream
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param object pointer to the message or attachment object
+   \param mem_ctx pointer to the memory context the stream is
+   allocated from
+   \param proptag the property tag of the stream
+   \param mode the access mode of the stream
+   \param streamp pointer to the stream to return, freeing it closes
+   the stream
+   \param sizep pointer to the size of the property to return
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_IMPLEMENTED
+   if the backend does not support streams, in which case the property
+   must be read and written as a whole, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_properties_open_property_stream(struct mapistore_context *mstore_ctx, uint32_t context_id,
+									void *object, TALLOC_CTX *mem_ctx,
+									enum MAPITAGS proptag, enum mapistore_stream_mode mode,
+									void **streamp, uint64_t *sizep)
+{
+	struct backend_context	*backend_ctx;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!streamp || !sizep, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	return mapistore_backend_properties_open_property_stream(backend_ctx, object, mem_ctx, proptag, mode, streamp, sizep);
+}
+
+/**
+   \details Copy the properties of a mapistore object onto another
+   object of the same context, without a round-trip per property
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param source_object pointer to the object to copy from
+   \param target_object pointer to the object to copy to
+   \param excluded_tags pointer to the list of properties that must not
+   be copied
+   \param deep_copy whether the recipients and attachments of messages
+   must be copied too
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_IMPLEMENTED
+   if the backend cannot copy objects itself, in which case the
+   properties must be copied one object at a time, otherwise MAPISTORE
+   error
+ */
+_PUBLIC_ enum mapistore_error mapistore_properties_copy_object(struct mapistore_context *mstore_ctx, uint32_t context_id,
+							       void *source_object, void *target_object,
+							       struct SPropTagArray *excluded_tags, bool deep_copy)
+{
+	struct backend_context	*backend_ctx;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!source_object || !target_object, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	return mapistore_backend_properties_copy_object(backend_ctx, source_object, target_object, excluded_tags, deep_copy);
+}
+
+/**
+   \details Read a chunk of a property stream
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param stream pointer to the stream opened with
+   mapistore_properties_open_property_stream
+   \param mem_ctx pointer to the memory context the data is allocated
+   from
+   \param offset the position to read from
+   \param length the maximum number of bytes to read
+   \param data pointer to the data to return, shorter than length at
+   the end of the stream
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_stream_read(struct mapistore_context *mstore_ctx, uint32_t context_id,
+						    void *stream, TALLOC_CTX *mem_ctx,
+						    uint64_t offset, uint32_t length, DATA_BLOB *data)
+{
+	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!stream || !data, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_stream_read(backend_ctx, stream, mem_ctx, offset, length, data);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
+/**
+   \details Write a chunk of a property stream
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param stream pointer to the stream opened for writing
+   \param offset the position to write at
+   \param data the data to write
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_stream_write(struct mapistore_context *mstore_ctx, uint32_t context_id,
+						     void *stream, uint64_t offset, DATA_BLOB data)
+{
+	struct backend_context	*backend_ctx;
+	enum mapistore_error	ret;
+	struct oc_trace_span	span;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!stream, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 1. Search the context */
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	/* Step 2. Call backend operation */
+	oc_trace_span_begin(&span, __FUNCTION__, context_id);
+	ret = mapistore_backend_stream_write(backend_ctx, stream, offset, data);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
+/**
+   \details Make the content written to a property stream the new
+   value of the property
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier referencing the backend
+   \param stream pointer to the stream opened for writing
+   \param size the size of the property, data past it is discarded
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_stream_commit(struct mapistore_context *mstore_ctx, uint32_t context_id,
+						      void *stream, uint64_t size)
+{
+	struct backend_context	*backend_ctx;
 
 	/* Sanity checks */
 	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!stream, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 1. Search the context */
-	backend_ctx = mapistore_backend_lookup(mstore_ctx->context_list, context_id);
+	backend_ctx = mapistore_backend_lookup(mstore_ctx, context_id);
 	MAPISTORE_RETVAL_IF(!backend_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
 	/* Step 2. Call backend operation */
-	return mapistore_backend_properties_set_properties(backend_ctx, object, aRow);
+	return mapistore_backend_stream_commit(backend_ctx, stream, size);
 }
 
 _PUBLIC_ enum MAPISTATUS mapistore_error_to_mapi(enum mapistore_error mapistore_err)
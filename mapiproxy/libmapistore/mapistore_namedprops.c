@@ -21,12 +21,56 @@
  */
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include "mapistore.h"
+#include "utils/dlinklist.h"
 
 #include "backends/namedprops_ldb.h"
 #include "backends/namedprops_mysql.h"
 
+#define	NAMEDPROPS_CACHE_BUCKETS	1024
+#define	NAMEDPROPS_CACHE_FIRST_ID	0x8000
+#define	NAMEDPROPS_CACHE_ID_COUNT	0x8000
+
+struct namedprops_cache_entry {
+	struct namedprops_cache_entry	*next;
+	struct MAPINAMEID		nameid;
+	uint16_t			mapped_id;
+};
+
+/* Named property mappings are append-only: once the backend returns
+   a mapping it never changes, so the cache never has to invalidate
+   anything. Lookups which fail are not cached since another process
+   may create the mapping later. */
+struct namedprops_cache {
+	struct namedprops_cache		*prev;
+	struct namedprops_cache		*next;
+	const char			*key;
+	struct namedprops_cache_entry	*buckets[NAMEDPROPS_CACHE_BUCKETS];
+	struct namedprops_cache_entry	**by_id;
+	int32_t				*prop_types;
+};
+
+static struct namedprops_cache *namedprops_cache_list;
+
+/* The mappings every database is provisioned with, generated from
+   mapi-named-properties at build time like mapistore_namedprops.ldif */
+struct mapistore_namedprops_default {
+	uint16_t	kind;
+	struct GUID	guid;
+	uint32_t	lid;
+	const char	*name;
+	uint16_t	mapped_id;
+	uint16_t	prop_type;
+};
+
+#include "mapistore_namedprops_table.h"
+
+#define	NAMEDPROPS_DEFAULTS_COUNT	(sizeof (mapistore_namedprops_defaults) / sizeof (mapistore_namedprops_defaults[0]))
+#define	NAMEDPROPS_DEFAULTS_IDS_COUNT	(sizeof (mapistore_namedprops_defaults_by_id) / sizeof (mapistore_namedprops_defaults_by_id[0]))
+
 
 /**
    \details Return the path to the ldif file holding initial set of
@@ -40,6 +84,317 @@ const char *mapistore_namedprops_get_ldif_path(void)
 }
 
 
+static int mapistore_namedprops_cache_destructor(struct namedprops_cache *cache)
+{
+	DLIST_REMOVE(namedprops_cache_list, cache);
+	return 0;
+}
+
+static uint32_t mapistore_namedprops_cache_hash(const struct MAPINAMEID *nameid)
+{
+	uint32_t	hash = 2166136261U;
+	const char	*name;
+	int		i;
+
+	hash = (hash ^ nameid->ulKind) * 16777619U;
+	hash = (hash ^ nameid->lpguid.time_low) * 16777619U;
+	hash = (hash ^ nameid->lpguid.time_mid) * 16777619U;
+	hash = (hash ^ nameid->lpguid.time_hi_and_version) * 16777619U;
+	for (i = 0; i < sizeof (nameid->lpguid.node); i++) {
+		hash = (hash ^ nameid->lpguid.node[i]) * 16777619U;
+	}
+	switch (nameid->ulKind) {
+	case MNID_ID:
+		hash = (hash ^ nameid->kind.lid) * 16777619U;
+		break;
+	case MNID_STRING:
+		for (name = nameid->kind.lpwstr.Name; name && *name; name++) {
+			hash = (hash ^ (uint8_t)*name) * 16777619U;
+		}
+		break;
+	}
+
+	return hash % NAMEDPROPS_CACHE_BUCKETS;
+}
+
+static bool mapistore_namedprops_cache_match(const struct MAPINAMEID *a, const struct MAPINAMEID *b)
+{
+	if (a->ulKind != b->ulKind) return false;
+	if (!GUID_equal(&a->lpguid, &b->lpguid)) return false;
+
+	switch (a->ulKind) {
+	case MNID_ID:
+		return (a->kind.lid == b->kind.lid);
+	case MNID_STRING:
+		return (b->kind.lpwstr.Name && !strcmp(a->kind.lpwstr.Name, b->kind.lpwstr.Name));
+	}
+
+	return false;
+}
+
+static struct namedprops_cache_entry *mapistore_namedprops_cache_find(struct namedprops_cache *cache,
+								      const struct MAPINAMEID *nameid)
+{
+	struct namedprops_cache_entry	*entry;
+
+	for (entry = cache->buckets[mapistore_namedprops_cache_hash(nameid)]; entry; entry = entry->next) {
+		if (mapistore_namedprops_cache_match(&entry->nameid, nameid)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* Same order as mapistore_namedprops_table() in mparse.pl */
+static int mapistore_namedprops_default_cmp(const void *key, const void *member)
+{
+	const struct MAPINAMEID				*nameid = key;
+	const struct mapistore_namedprops_default	*entry = member;
+	int						i;
+
+#define	NAMEDPROPS_DEFAULT_CMP(a, b)	if ((a) != (b)) return ((a) < (b)) ? -1 : 1
+	NAMEDPROPS_DEFAULT_CMP(nameid->ulKind, entry->kind);
+	NAMEDPROPS_DEFAULT_CMP(nameid->lpguid.time_low, entry->guid.time_low);
+	NAMEDPROPS_DEFAULT_CMP(nameid->lpguid.time_mid, entry->guid.time_mid);
+	NAMEDPROPS_DEFAULT_CMP(nameid->lpguid.time_hi_and_version, entry->guid.time_hi_and_version);
+	for (i = 0; i < 2; i++) {
+		NAMEDPROPS_DEFAULT_CMP(nameid->lpguid.clock_seq[i], entry->guid.clock_seq[i]);
+	}
+	for (i = 0; i < 6; i++) {
+		NAMEDPROPS_DEFAULT_CMP(nameid->lpguid.node[i], entry->guid.node[i]);
+	}
+	if (nameid->ulKind == MNID_ID) {
+		NAMEDPROPS_DEFAULT_CMP(nameid->kind.lid, entry->lid);
+		return 0;
+	}
+#undef	NAMEDPROPS_DEFAULT_CMP
+
+	/* backends match names case-insensitively */
+	return strcasecmp(nameid->kind.lpwstr.Name, entry->name);
+}
+
+static const struct mapistore_namedprops_default *mapistore_namedprops_default_find(const struct MAPINAMEID *nameid)
+{
+	if (nameid->ulKind != MNID_ID && nameid->ulKind != MNID_STRING) return NULL;
+	if (nameid->ulKind == MNID_STRING && !nameid->kind.lpwstr.Name) return NULL;
+
+	return bsearch(nameid, mapistore_namedprops_defaults, NAMEDPROPS_DEFAULTS_COUNT,
+		       sizeof (mapistore_namedprops_defaults[0]), mapistore_namedprops_default_cmp);
+}
+
+static const struct mapistore_namedprops_default *mapistore_namedprops_default_by_id(uint16_t mapped_id)
+{
+	const struct mapistore_namedprops_default	*entry;
+	size_t						first = 0;
+	size_t						last = NAMEDPROPS_DEFAULTS_IDS_COUNT;
+	size_t						middle;
+
+	while (first < last) {
+		middle = first + (last - first) / 2;
+		entry = &mapistore_namedprops_defaults[mapistore_namedprops_defaults_by_id[middle]];
+		if (entry->mapped_id == mapped_id) {
+			return entry;
+		} else if (entry->mapped_id < mapped_id) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+
+	return NULL;
+}
+
+/* Number of default mappings checked against the database */
+#define	NAMEDPROPS_DEFAULTS_CHECKS	16
+
+/**
+   \details Enable the compiled-in default mappings on a namedprops
+   context if the database agrees with them
+
+   The database is provisioned with the same mappings, but one
+   provisioned by an older version may map some names differently: a
+   sample of them spread over the table is checked with one lookup.
+
+   \param nprops pointer to the namedprops context
+
+   \return true if the default mappings are used, otherwise false
+ */
+static bool mapistore_namedprops_defaults_enable(struct namedprops_context *nprops)
+{
+	struct MAPINAMEID	nameids[NAMEDPROPS_DEFAULTS_CHECKS];
+	uint16_t		mapped_ids[NAMEDPROPS_DEFAULTS_CHECKS];
+	uint16_t		expected[NAMEDPROPS_DEFAULTS_CHECKS];
+	const struct mapistore_namedprops_default *entry;
+	uint32_t		i;
+
+	if (!nprops->get_mapped_ids) return false;
+
+	memset(nameids, 0, sizeof (nameids));
+	for (i = 0; i < NAMEDPROPS_DEFAULTS_CHECKS; i++) {
+		entry = &mapistore_namedprops_defaults[i * (NAMEDPROPS_DEFAULTS_COUNT - 1) / (NAMEDPROPS_DEFAULTS_CHECKS - 1)];
+		nameids[i].ulKind = entry->kind;
+		nameids[i].lpguid = entry->guid;
+		if (entry->kind == MNID_ID) {
+			nameids[i].kind.lid = entry->lid;
+		} else {
+			nameids[i].kind.lpwstr.Name = entry->name;
+			nameids[i].kind.lpwstr.NameSize = strlen(entry->name) * 2 + 2;
+		}
+		expected[i] = entry->mapped_id;
+	}
+
+	if (nprops->get_mapped_ids(nprops, NAMEDPROPS_DEFAULTS_CHECKS, nameids, mapped_ids) != MAPISTORE_SUCCESS) {
+		return false;
+	}
+	for (i = 0; i < NAMEDPROPS_DEFAULTS_CHECKS; i++) {
+		if (mapped_ids[i] != expected[i]) {
+			oc_log(OC_LOG_WARNING, "named properties database does not match the default mappings, "
+			       "they are looked up in the database");
+			return false;
+		}
+	}
+
+	nprops->defaults = true;
+
+	return true;
+}
+
+
+/**
+   \details Record a mapping returned by the backend in both
+   directions of the cache
+
+   \param cache pointer to the named properties cache
+   \param nameid the named property
+   \param mapped_id the property ID the named property is mapped to
+ */
+static void mapistore_namedprops_cache_add(struct namedprops_cache *cache,
+					   const struct MAPINAMEID *nameid,
+					   uint16_t mapped_id)
+{
+	struct namedprops_cache_entry	*entry;
+	uint32_t			bucket;
+
+	if (nameid->ulKind != MNID_ID && nameid->ulKind != MNID_STRING) return;
+	if (nameid->ulKind == MNID_STRING && !nameid->kind.lpwstr.Name) return;
+
+	entry = mapistore_namedprops_cache_find(cache, nameid);
+	if (!entry) {
+		entry = talloc_zero(cache, struct namedprops_cache_entry);
+		if (!entry) return;
+
+		entry->nameid = *nameid;
+		if (nameid->ulKind == MNID_STRING) {
+			entry->nameid.kind.lpwstr.Name = talloc_strdup(entry, nameid->kind.lpwstr.Name);
+			if (!entry->nameid.kind.lpwstr.Name) {
+				talloc_free(entry);
+				return;
+			}
+			entry->nameid.kind.lpwstr.NameSize = strlen(nameid->kind.lpwstr.Name) * 2 + 2;
+		}
+		entry->mapped_id = mapped_id;
+
+		bucket = mapistore_namedprops_cache_hash(nameid);
+		entry->next = cache->buckets[bucket];
+		cache->buckets[bucket] = entry;
+	}
+
+	/* Backends may match names case-insensitively, keep the first
+	   spelling for the reverse lookup */
+	if (entry->mapped_id >= NAMEDPROPS_CACHE_FIRST_ID &&
+	    !cache->by_id[entry->mapped_id - NAMEDPROPS_CACHE_FIRST_ID]) {
+		cache->by_id[entry->mapped_id - NAMEDPROPS_CACHE_FIRST_ID] = entry;
+	}
+}
+
+
+/**
+   \details Attach the process-wide named properties cache matching
+   key to a namedprops context, creating it on first use
+
+   All the namedprops contexts opened on the same database within a
+   process share the same cache, which is released with the last
+   context referencing it.
+
+   \param nprops pointer to the namedprops context
+   \param key string identifying the backend database
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_namedprops_cache_attach(struct namedprops_context *nprops,
+						       const char *key)
+{
+	struct namedprops_cache	*cache;
+	int			i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!key, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	for (cache = namedprops_cache_list; cache; cache = cache->next) {
+		if (!strcmp(cache->key, key)) {
+			nprops->cache = talloc_reference(nprops, cache);
+			MAPISTORE_RETVAL_IF(!nprops->cache, MAPISTORE_ERR_NO_MEMORY, NULL);
+			return MAPISTORE_SUCCESS;
+		}
+	}
+
+	cache = talloc_zero(nprops, struct namedprops_cache);
+	MAPISTORE_RETVAL_IF(!cache, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	cache->key = talloc_strdup(cache, key);
+	MAPISTORE_RETVAL_IF(!cache->key, MAPISTORE_ERR_NO_MEMORY, cache);
+
+	cache->by_id = talloc_zero_array(cache, struct namedprops_cache_entry *, NAMEDPROPS_CACHE_ID_COUNT);
+	MAPISTORE_RETVAL_IF(!cache->by_id, MAPISTORE_ERR_NO_MEMORY, cache);
+
+	cache->prop_types = talloc_array(cache, int32_t, NAMEDPROPS_CACHE_ID_COUNT);
+	MAPISTORE_RETVAL_IF(!cache->prop_types, MAPISTORE_ERR_NO_MEMORY, cache);
+	for (i = 0; i < NAMEDPROPS_CACHE_ID_COUNT; i++) {
+		cache->prop_types[i] = -1;
+	}
+
+	DLIST_ADD(namedprops_cache_list, cache);
+	talloc_set_destructor(cache, mapistore_namedprops_cache_destructor);
+
+	nprops->cache = cache;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Build the string identifying the database a named
+   properties backend is configured to use
+
+   \param mem_ctx pointer to the memory context
+   \param lp_ctx pointer to the loadparm context
+   \param backend the named properties backend name
+
+   \return allocated string on success, otherwise NULL
+ */
+static char *mapistore_namedprops_cache_key(TALLOC_CTX *mem_ctx,
+					    struct loadparm_context *lp_ctx,
+					    const char *backend)
+{
+	const char	*host;
+	const char	*db;
+
+	if (!strcmp(backend, NAMEDPROPS_BACKEND_MYSQL)) {
+		host = lpcfg_parm_string(lp_ctx, NULL, "namedproperties", "mysql_host");
+		db = lpcfg_parm_string(lp_ctx, NULL, "namedproperties", "mysql_db");
+		return talloc_asprintf(mem_ctx, "%s://%s:%d/%s", backend,
+				       host ? host : "",
+				       lpcfg_parm_int(lp_ctx, NULL, "namedproperties", "mysql_port", 3306),
+				       db ? db : "");
+	}
+
+	return talloc_asprintf(mem_ctx, "%s://%s", backend,
+			       lpcfg_parm_string(lp_ctx, NULL, "namedproperties", "ldb_url"));
+}
+
+
 /**
    \details Initialize the named properties database or return pointer
    to the existing one if already initialized/opened.
@@ -55,7 +410,9 @@ enum mapistore_error mapistore_namedprops_init(TALLOC_CTX *mem_ctx,
 					       struct loadparm_context *lp_ctx,
 					       struct namedprops_context **nprops)
 {
-	const char	*backend;
+	enum mapistore_error	retval;
+	const char		*backend;
+	char			*key;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
@@ -69,14 +426,77 @@ enum mapistore_error mapistore_namedprops_init(TALLOC_CTX *mem_ctx,
 		backend = NAMEDPROPS_BACKEND_LDB;
 	}
 	if (!strncmp(backend, NAMEDPROPS_BACKEND_LDB, strlen(NAMEDPROPS_BACKEND_LDB))) {
-		return mapistore_namedprops_ldb_init(mem_ctx, lp_ctx, nprops);
+		retval = mapistore_namedprops_ldb_init(mem_ctx, lp_ctx, nprops);
 	} else if (!strncmp(backend, NAMEDPROPS_BACKEND_MYSQL, strlen(NAMEDPROPS_BACKEND_MYSQL))) {
-		return mapistore_namedprops_mysql_init(mem_ctx, lp_ctx, nprops);
+		retval = mapistore_namedprops_mysql_init(mem_ctx, lp_ctx, nprops);
 	} else {
 		oc_log(OC_LOG_ERROR, "Invalid namedproperties backend type '%s'", backend);
+		return MAPISTORE_ERR_INVALID_PARAMETER;
 	}
+	MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, NULL);
 
-	return MAPISTORE_ERR_INVALID_PARAMETER;
+	/* Provisioned mappings are answered without the database */
+	if (lpcfg_parm_bool(lp_ctx, NULL, "namedproperties", "defaults_table", true)) {
+		mapistore_namedprops_defaults_enable(*nprops);
+	}
+
+	/* Share mappings between all the contexts using this database */
+	if (lpcfg_parm_bool(lp_ctx, NULL, "namedproperties", "cache", true)) {
+		key = mapistore_namedprops_cache_key(mem_ctx, lp_ctx, (*nprops)->backend_type);
+		MAPISTORE_RETVAL_IF(!key, MAPISTORE_ERR_NO_MEMORY, NULL);
+		retval = mapistore_namedprops_cache_attach(*nprops, key);
+		talloc_free(key);
+		MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, NULL);
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Load every mapping of the named properties database in the
+   process-wide cache
+
+   \param nprops pointer to the namedprops context
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_namedprops_cache_preload(struct namedprops_context *nprops)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct MAPINAMEID	*nameid;
+	enum mapistore_error	retval;
+	uint16_t		next_id = 0;
+	uint16_t		prop_type;
+	uint32_t		id;
+	uint32_t		count = 0;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!nprops->cache, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	retval = nprops->next_unused_id(nprops, &next_id);
+	MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, NULL);
+
+	mem_ctx = talloc_named(NULL, 0, "mapistore_namedprops_cache_preload");
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (id = NAMEDPROPS_CACHE_FIRST_ID; id < next_id; id++) {
+		/* already in memory */
+		if (nprops->defaults && mapistore_namedprops_default_by_id(id)) {
+			continue;
+		}
+		if (mapistore_namedprops_get_nameid(nprops, id, mem_ctx, &nameid) != MAPISTORE_SUCCESS) {
+			continue;
+		}
+		mapistore_namedprops_get_nameid_type(nprops, id, &prop_type);
+		count++;
+	}
+	talloc_free(mem_ctx);
+
+	OC_DEBUG(3, "%u named properties loaded in the cache", count);
+
+	return MAPISTORE_SUCCESS;
 }
 
 
@@ -140,10 +560,148 @@ _PUBLIC_ enum mapistore_error mapistore_namedprops_get_mapped_id(struct namedpro
 								 struct MAPINAMEID nameid,
 								 uint16_t *propID)
 {
+	const struct mapistore_namedprops_default	*default_entry;
+	struct namedprops_cache_entry	*entry;
+	enum mapistore_error		retval;
+
 	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(!propID, MAPISTORE_ERROR, NULL);
 
-	return nprops->get_mapped_id(nprops, nameid, propID);
+	if (nprops->defaults) {
+		default_entry = mapistore_namedprops_default_find(&nameid);
+		if (default_entry) {
+			*propID = default_entry->mapped_id;
+			return MAPISTORE_SUCCESS;
+		}
+	}
+
+	if (nprops->cache) {
+		entry = mapistore_namedprops_cache_find(nprops->cache, &nameid);
+		if (entry) {
+			*propID = entry->mapped_id;
+			return MAPISTORE_SUCCESS;
+		}
+	}
+
+	retval = nprops->get_mapped_id(nprops, nameid, propID);
+	if (retval == MAPISTORE_SUCCESS && nprops->cache) {
+		mapistore_namedprops_cache_add(nprops->cache, &nameid, *propID);
+	}
+
+	return retval;
+}
+
+/**
+   \details Return the mapped property IDs of several named properties
+
+   Default mappings and mappings found in the cache are not looked up
+   again, the others are looked up in the backend at once.
+
+   \param nprops pointer to the namedprops context
+   \param count number of named properties
+   \param nameids the named properties to look up
+   \param propIDs array of count property IDs the function returns,
+   0 for the named properties which are not mapped
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_namedprops_get_mapped_ids(struct namedprops_context *nprops,
+								  uint32_t count,
+								  struct MAPINAMEID *nameids,
+								  uint16_t *propIDs)
+{
+	TALLOC_CTX			*mem_ctx;
+	const struct mapistore_namedprops_default	*default_entry;
+	struct namedprops_cache_entry	*entry;
+	struct MAPINAMEID		*missing;
+	uint16_t			*missing_ids;
+	uint32_t			*missing_idx;
+	uint32_t			missing_count = 0;
+	uint32_t			i;
+	enum mapistore_error		retval;
+
+	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERROR, NULL);
+	MAPISTORE_RETVAL_IF(count && (!nameids || !propIDs), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	if (!count) return MAPISTORE_SUCCESS;
+
+	mem_ctx = talloc_named(NULL, 0, "mapistore_namedprops_get_mapped_ids");
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+	missing = talloc_array(mem_ctx, struct MAPINAMEID, count);
+	missing_ids = talloc_array(mem_ctx, uint16_t, count);
+	missing_idx = talloc_array(mem_ctx, uint32_t, count);
+	MAPISTORE_RETVAL_IF(!missing || !missing_ids || !missing_idx, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	for (i = 0; i < count; i++) {
+		propIDs[i] = 0;
+		if (nprops->defaults) {
+			default_entry = mapistore_namedprops_default_find(&nameids[i]);
+			if (default_entry) {
+				propIDs[i] = default_entry->mapped_id;
+				continue;
+			}
+		}
+		if (nprops->cache) {
+			entry = mapistore_namedprops_cache_find(nprops->cache, &nameids[i]);
+			if (entry) {
+				propIDs[i] = entry->mapped_id;
+				continue;
+			}
+		}
+		missing[missing_count] = nameids[i];
+		missing_idx[missing_count] = i;
+		missing_count++;
+	}
+
+	if (missing_count) {
+		retval = nprops->get_mapped_ids(nprops, missing_count, missing, missing_ids);
+		MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, mem_ctx);
+
+		for (i = 0; i < missing_count; i++) {
+			if (!missing_ids[i]) continue;
+			propIDs[missing_idx[i]] = missing_ids[i];
+			if (nprops->cache) {
+				mapistore_namedprops_cache_add(nprops->cache, &missing[i], missing_ids[i]);
+			}
+		}
+	}
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Map several named properties at once
+
+   \param nprops pointer to the namedprops context
+   \param count number of named properties
+   \param nameids the named properties to map
+   \param mapped_ids the property IDs to map them to
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_namedprops_create_ids(struct namedprops_context *nprops,
+							      uint32_t count,
+							      struct MAPINAMEID *nameids,
+							      const uint16_t *mapped_ids)
+{
+	enum mapistore_error	retval;
+	uint32_t		i;
+
+	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERROR, NULL);
+	MAPISTORE_RETVAL_IF(count && (!nameids || !mapped_ids), MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	if (!count) return MAPISTORE_SUCCESS;
+
+	retval = nprops->create_ids(nprops, count, nameids, mapped_ids);
+	MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, NULL);
+
+	if (nprops->cache) {
+		for (i = 0; i < count; i++) {
+			mapistore_namedprops_cache_add(nprops->cache, &nameids[i], mapped_ids[i]);
+		}
+	}
+
+	return MAPISTORE_SUCCESS;
 }
 
 /**
@@ -161,11 +719,55 @@ _PUBLIC_ enum mapistore_error mapistore_namedprops_get_nameid(struct namedprops_
 							      TALLOC_CTX *mem_ctx,
 							      struct MAPINAMEID **nameidp)
 {
+	const struct mapistore_namedprops_default	*default_entry;
+	struct namedprops_cache_entry	*entry;
+	struct MAPINAMEID		*nameid;
+	enum mapistore_error		retval;
+
 	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(propID < 0x8000, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(!nameidp, MAPISTORE_ERROR, NULL);
 
-	return nprops->get_nameid(nprops, propID, mem_ctx, nameidp);
+	if (nprops->defaults) {
+		default_entry = mapistore_namedprops_default_by_id(propID);
+		if (default_entry) {
+			nameid = talloc_zero(mem_ctx, struct MAPINAMEID);
+			MAPISTORE_RETVAL_IF(!nameid, MAPISTORE_ERR_NO_MEMORY, NULL);
+			nameid->ulKind = default_entry->kind;
+			nameid->lpguid = default_entry->guid;
+			if (default_entry->kind == MNID_ID) {
+				nameid->kind.lid = default_entry->lid;
+			} else {
+				nameid->kind.lpwstr.Name = talloc_strdup(nameid, default_entry->name);
+				MAPISTORE_RETVAL_IF(!nameid->kind.lpwstr.Name, MAPISTORE_ERR_NO_MEMORY, nameid);
+				nameid->kind.lpwstr.NameSize = strlen(default_entry->name) * 2 + 2;
+			}
+			*nameidp = nameid;
+			return MAPISTORE_SUCCESS;
+		}
+	}
+
+	if (nprops->cache) {
+		entry = nprops->cache->by_id[propID - NAMEDPROPS_CACHE_FIRST_ID];
+		if (entry) {
+			nameid = talloc_zero(mem_ctx, struct MAPINAMEID);
+			MAPISTORE_RETVAL_IF(!nameid, MAPISTORE_ERR_NO_MEMORY, NULL);
+			*nameid = entry->nameid;
+			if (nameid->ulKind == MNID_STRING) {
+				nameid->kind.lpwstr.Name = talloc_strdup(nameid, entry->nameid.kind.lpwstr.Name);
+				MAPISTORE_RETVAL_IF(!nameid->kind.lpwstr.Name, MAPISTORE_ERR_NO_MEMORY, nameid);
+			}
+			*nameidp = nameid;
+			return MAPISTORE_SUCCESS;
+		}
+	}
+
+	retval = nprops->get_nameid(nprops, propID, mem_ctx, nameidp);
+	if (retval == MAPISTORE_SUCCESS && nprops->cache && *nameidp) {
+		mapistore_namedprops_cache_add(nprops->cache, *nameidp, propID);
+	}
+
+	return retval;
 }
 
 /**
@@ -181,12 +783,23 @@ _PUBLIC_ enum mapistore_error mapistore_namedprops_get_nameid_type(struct namedp
 								   uint16_t propID,
 								   uint16_t *propTypeP)
 {
+	const struct mapistore_namedprops_default	*default_entry;
+
 	MAPISTORE_RETVAL_IF(!nprops, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(propID < 0x8000, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(!propTypeP, MAPISTORE_ERROR, NULL);
 
-	int ret = nprops->get_nameid_type(nprops, propID, propTypeP);
-	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+	if (nprops->defaults && (default_entry = mapistore_namedprops_default_by_id(propID))) {
+		*propTypeP = default_entry->prop_type;
+	} else if (nprops->cache && nprops->cache->prop_types[propID - NAMEDPROPS_CACHE_FIRST_ID] != -1) {
+		*propTypeP = nprops->cache->prop_types[propID - NAMEDPROPS_CACHE_FIRST_ID];
+	} else {
+		int ret = nprops->get_nameid_type(nprops, propID, propTypeP);
+		MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+		if (nprops->cache) {
+			nprops->cache->prop_types[propID - NAMEDPROPS_CACHE_FIRST_ID] = *propTypeP;
+		}
+	}
 
 	switch (*propTypeP) {
 	case PT_UNSPECIFIED:
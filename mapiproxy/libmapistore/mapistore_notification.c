@@ -21,6 +21,8 @@
 
 #include <ctype.h>
 #include "mapiproxy/libmapistore/mapistore_notification.h"
+#include "utils/dlinklist.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
 
 /**
    \details Map memcached to mapistore error mapping
@@ -90,6 +92,7 @@ enum mapistore_error mapistore_notification_init(TALLOC_CTX *mem_ctx,
 						 struct mapistore_notification_context **_notification_ctx)
 {
 	struct mapistore_notification_context	*notification_ctx = NULL;
+	enum mapistore_error			retval;
 	const char				*url = NULL;
 	memcached_server_st			*servers = NULL;
 	memcached_return			rc;
@@ -118,13 +121,124 @@ enum mapistore_error mapistore_notification_init(TALLOC_CTX *mem_ctx,
 		MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERR_CONTEXT_FAILED, notification_ctx);
 	}
 
+	/* Records are updated with check-and-set */
+	rc = memcached_behavior_set(notification_ctx->memc_ctx, MEMCACHED_BEHAVIOR_SUPPORT_CAS, 1);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERR_CONTEXT_FAILED, notification_ctx);
+
+	/* Binary requests are parsed without text scanning and records
+	   stay on their server when the server list changes */
+	rc = memcached_behavior_set(notification_ctx->memc_ctx, MEMCACHED_BEHAVIOR_BINARY_PROTOCOL, 1);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERR_CONTEXT_FAILED, notification_ctx);
+	rc = memcached_behavior_set(notification_ctx->memc_ctx, MEMCACHED_BEHAVIOR_KETAMA_WEIGHTED, 1);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, MAPISTORE_ERR_CONTEXT_FAILED, notification_ctx);
+
 	talloc_set_destructor((void *)notification_ctx, (int (*)(void *))mapistore_notification_destructor);
 
+	notification_ctx->local_subscriptions = lpcfg_parm_bool(lp_ctx, NULL, "mapistore", "notification_local_subscriptions", true);
+
+	/* Select the bus carrying the deliveries */
+	retval = mapistore_notification_bus_init(notification_ctx, lp_ctx, &notification_ctx->bus);
+	MAPISTORE_RETVAL_IF(retval, retval, notification_ctx);
+
 	*_notification_ctx = notification_ctx;
 	return MAPISTORE_SUCCESS;
 }
 
 
+/**
+   \details Retrieve a record and its CAS identifier in a single
+   round-trip
+
+   \param mem_ctx pointer to the memory context
+   \param memc_ctx pointer to the memcached context
+   \param key the key to fetch
+   \param blob pointer to the value to return
+   \param cas pointer to the CAS identifier to return
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if
+   the key does not exist, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_notification_fetch(TALLOC_CTX *mem_ctx,
+							 memcached_st *memc_ctx,
+							 const char *key,
+							 DATA_BLOB *blob,
+							 uint64_t *cas)
+{
+	enum mapistore_error	retval = MAPISTORE_ERR_NOT_FOUND;
+	memcached_result_st	*result;
+	memcached_return_t	rc;
+	const char		*keys[1];
+	size_t			keys_len[1];
+
+	keys[0] = key;
+	keys_len[0] = strlen(key);
+	rc = memcached_mget(memc_ctx, keys, keys_len, 1);
+	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), NULL);
+
+	/* Drain the results so the connection is ready for next command */
+	while ((result = memcached_fetch_result(memc_ctx, NULL, &rc)) != NULL) {
+		if (retval == MAPISTORE_ERR_NOT_FOUND) {
+			blob->length = memcached_result_length(result);
+			blob->data = talloc_memdup(mem_ctx, (uint8_t *) memcached_result_value(result), blob->length);
+			*cas = memcached_result_cas(result);
+			retval = blob->data ? MAPISTORE_SUCCESS : MAPISTORE_ERR_NO_MEMORY;
+		}
+		memcached_result_free(result);
+	}
+	if (retval == MAPISTORE_ERR_NOT_FOUND && rc != MEMCACHED_END && rc != MEMCACHED_NOTFOUND) {
+		retval = ret_to_mapistore(rc);
+	}
+
+	return retval;
+}
+
+
+/**
+   \details Store a record previously retrieved with
+   mapistore_notification_fetch, or create it if it did not exist
+
+   \param memc_ctx pointer to the memcached context
+   \param key the key to store
+   \param ndr pointer to the ndr push context holding the value
+   \param exist whether the record was found when fetched
+   \param cas the CAS identifier returned when fetched
+
+   \return MEMCACHED_SUCCESS on success, MEMCACHED_DATA_EXISTS,
+   MEMCACHED_NOTSTORED or MEMCACHED_NOTFOUND if the record was
+   modified by another instance in the meantime, otherwise memcached
+   error
+ */
+static memcached_return mapistore_notification_store(memcached_st *memc_ctx,
+						     const char *key,
+						     struct ndr_push *ndr,
+						     bool exist,
+						     uint64_t cas)
+{
+	if (exist) {
+		return memcached_cas(memc_ctx, key, strlen(key), (char *) ndr->data,
+				     ndr->offset, 0, 0, cas);
+	}
+
+	return memcached_add(memc_ctx, key, strlen(key), (char *) ndr->data,
+			     ndr->offset, 0, 0);
+}
+
+
+/**
+   \details Check if a store operation failed because the record was
+   concurrently modified, in which case the read-modify-write cycle
+   should be restarted
+
+   \param rc the memcached return value to check
+
+   \return true if the operation should be retried, otherwise false
+ */
+static bool mapistore_notification_store_conflict(memcached_return rc)
+{
+	return (rc == MEMCACHED_DATA_EXISTS || rc == MEMCACHED_NOTSTORED || rc == MEMCACHED_NOTFOUND);
+}
+
+
 /**
    \details Generate the session key
 
@@ -421,6 +535,34 @@ static enum mapistore_error mapistore_notification_resolver_set_key(TALLOC_CTX *
 }
 
 
+/**
+   \details Unpack a resolver record
+
+   \param mem_ctx pointer to the memory context
+   \param blob pointer to the record value
+   \param r pointer to the resolver structure to return
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_notification_resolver_unpack(TALLOC_CTX *mem_ctx,
+								   DATA_BLOB *blob,
+								   struct mapistore_notification_resolver *r)
+{
+	struct ndr_pull		*ndr;
+	enum ndr_err_code	ndr_err_code;
+
+	ndr = ndr_pull_init_blob(blob, mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+
+	ndr_err_code = ndr_pull_mapistore_notification_resolver(ndr, NDR_SCALARS, r);
+	talloc_free(ndr);
+	MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+
 /**
    \details Add a record to the resolver
 
@@ -432,16 +574,10 @@ static enum mapistore_error mapistore_notification_resolver_set_key(TALLOC_CTX *
    of a new key/value pair and the update of an existing record. The
    following logic is implemented:
 
-   [START] Does the key exist?
-	If yes: Update record
-	If no: Insert key
-
-   \todo Note that a race condition is possible between the exist
-   check and the addition of the record, where the same key could have
-   been created by another instance, leading to the failure of the add
-   operation. While this scenario is very unlikely to happen in real
-   world, a retry with a counter should be implemented in further
-   iterations to reasonably circumvent this use case.
+   [START] Fetch the record and its CAS identifier
+	If found: Update record if not modified in the meantime
+	If not found: Insert key if not created in the meantime
+	On conflict: retry from [START]
 
    \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
  */
@@ -456,6 +592,11 @@ _PUBLIC_ enum mapistore_error mapistore_notification_resolver_add(struct mapisto
 	enum ndr_err_code			ndr_err_code;
 	memcached_return			rc = MEMCACHED_ERROR;
 	char					*key = NULL;
+	DATA_BLOB				blob;
+	uint64_t				cas = 0;
+	bool					exist;
+	uint32_t				i;
+	int					retry;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -471,59 +612,51 @@ _PUBLIC_ enum mapistore_error mapistore_notification_resolver_add(struct mapisto
 	retval = mapistore_notification_resolver_set_key(mem_ctx, cn, &key);
 	MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
 
-	/* Create resolver v1 value */
-	ndr = ndr_push_init_ctx(mem_ctx);
-	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-	ndr->offset = 0;
-
-	/* If the key already exist: update if no duplicate */
-	retval = mapistore_notification_resolver_exist(mstore_ctx, cn);
-	if (retval == MAPISTORE_SUCCESS) {
-		uint32_t	count = 0;
-		uint32_t	i = 0;
-		const char	**hosts = NULL;
-
-		retval = mapistore_notification_resolver_get(mem_ctx, mstore_ctx, cn, &count, &hosts);
-		MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
-
-		for (i = 0; i < count; i++) {
-			if (hosts[i] && !strncmp(hosts[i], host, strlen(host))) {
-				OC_DEBUG(0, "host '%s' is already registered for cn '%s'", host, cn);
-				talloc_free(mem_ctx);
-				return MAPISTORE_ERR_EXIST;
+	for (retry = 0; retry < MSTORE_MEMC_CAS_RETRY; retry++) {
+		retval = mapistore_notification_fetch(mem_ctx, mstore_ctx->notification_ctx->memc_ctx,
+						      key, &blob, &cas);
+		if (retval == MAPISTORE_SUCCESS) {
+			/* The key already exist: update if no duplicate */
+			exist = true;
+			retval = mapistore_notification_resolver_unpack(mem_ctx, &blob, &r);
+			MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
+
+			for (i = 0; i < r.v.v1.count; i++) {
+				if (r.v.v1.hosts[i] && !strncmp(r.v.v1.hosts[i], host, strlen(host))) {
+					OC_DEBUG(0, "host '%s' is already registered for cn '%s'", host, cn);
+					talloc_free(mem_ctx);
+					return MAPISTORE_ERR_EXIST;
+				}
 			}
-		}
 
-		r.vnum = 1;
-		r.v.v1.count = count + 1;
-		r.v.v1.hosts = talloc_array(mem_ctx, const char *, r.v.v1.count);
-		for (i = 0; i < count; i++) {
-			r.v.v1.hosts[i] = talloc_strdup(r.v.v1.hosts, hosts[i]);
-			MAPISTORE_RETVAL_IF(!r.v.v1.hosts[i], MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+			r.v.v1.hosts = talloc_realloc(mem_ctx, r.v.v1.hosts, const char *, r.v.v1.count + 1);
+			MAPISTORE_RETVAL_IF(!r.v.v1.hosts, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		} else if (retval == MAPISTORE_ERR_NOT_FOUND) {
+			exist = false;
+			r.v.v1.count = 0;
+			r.v.v1.hosts = talloc_array(mem_ctx, const char *, 1);
+			MAPISTORE_RETVAL_IF(!r.v.v1.hosts, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		} else {
+			MAPISTORE_RETVAL_ERR(retval, mem_ctx);
 		}
-		r.v.v1.hosts[count] = talloc_strdup(r.v.v1.hosts, host);
-		MAPISTORE_RETVAL_IF(!r.v.v1.hosts[count], MAPISTORE_ERR_NO_MEMORY, mem_ctx);
 
-		ndr_err_code = ndr_push_mapistore_notification_resolver(ndr, NDR_SCALARS, &r);
-		MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, mem_ctx);
-
-		/* Add the key/value record */
-		rc = memcached_set(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
-				   (char *)ndr->data, ndr->offset, 0, 0);
-	} else if (retval == MAPISTORE_ERR_NOT_FOUND) {
 		r.vnum = 1;
-		r.v.v1.count = 1;
-		r.v.v1.hosts = talloc_array(mem_ctx, const char *, 1);
-		MAPISTORE_RETVAL_IF(!r.v.v1.hosts, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-		r.v.v1.hosts[0] = talloc_strdup(r.v.v1.hosts, host);
-		MAPISTORE_RETVAL_IF(!r.v.v1.hosts[0], MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		r.v.v1.hosts[r.v.v1.count] = talloc_strdup(r.v.v1.hosts, host);
+		MAPISTORE_RETVAL_IF(!r.v.v1.hosts[r.v.v1.count], MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		r.v.v1.count += 1;
+
+		/* Create resolver v1 value */
+		ndr = ndr_push_init_ctx(mem_ctx);
+		MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		ndr->offset = 0;
 
 		ndr_err_code = ndr_push_mapistore_notification_resolver(ndr, NDR_SCALARS, &r);
 		MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, mem_ctx);
 
-		/* Add the key/value record */
-		rc = memcached_add(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
-				   (char *)ndr->data, ndr->offset, 0, 0);
+		/* Add or update the key/value record */
+		rc = mapistore_notification_store(mstore_ctx->notification_ctx->memc_ctx, key, ndr, exist, cas);
+		if (!mapistore_notification_store_conflict(rc)) break;
+		OC_DEBUG(5, "resolver record '%s' modified concurrently, retrying", key);
 	}
 
 	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
@@ -552,15 +685,10 @@ _PUBLIC_ enum mapistore_error mapistore_notification_resolver_get(TALLOC_CTX *me
 {
 	TALLOC_CTX				*local_mem_ctx;
 	enum mapistore_error			retval;
-	enum ndr_err_code			ndr_err_code;
-	struct ndr_pull				*ndr;
 	struct mapistore_notification_resolver	r;
 	DATA_BLOB				blob;
 	char					*key = NULL;
-	char					*value = NULL;
-	size_t					value_len = 0;
-	memcached_return_t			rc;
-	uint32_t				flags;
+	uint64_t				cas;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -576,24 +704,14 @@ _PUBLIC_ enum mapistore_error mapistore_notification_resolver_get(TALLOC_CTX *me
 	retval = mapistore_notification_resolver_set_key(local_mem_ctx, cn, &key);
 	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
 
-	value = memcached_get(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key), &value_len,
-			      &flags, &rc);
+	retval = mapistore_notification_fetch(local_mem_ctx, mstore_ctx->notification_ctx->memc_ctx,
+					      key, &blob, &cas);
 	talloc_free(key);
-	MAPISTORE_RETVAL_IF(!value, ret_to_mapistore(rc), local_mem_ctx);
+	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
 
 	/* Unpack resolver structure */
-	blob.data = talloc_memdup(local_mem_ctx, (uint8_t *) value, value_len);
-	free(value);
-	MAPISTORE_RETVAL_IF(!blob.data, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
-	blob.length = value_len;
-
-	ndr = ndr_pull_init_blob(&blob, local_mem_ctx);
-	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
-	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
-
-	ndr_err_code = ndr_pull_mapistore_notification_resolver(ndr, NDR_SCALARS, &r);
-	talloc_free(ndr);
-	MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, local_mem_ctx);
+	retval = mapistore_notification_resolver_unpack(local_mem_ctx, &blob, &r);
+	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
 
 	*countp = r.v.v1.count;
 	*hostsp = talloc_steal(mem_ctx, r.v.v1.hosts);
@@ -689,6 +807,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_resolver_delete(struct mapi
 	rc = memcached_set(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
 			   (char *)ndr->data, ndr->offset, 0, 0);
 	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
+	mapistore_notification_local_set(mstore_ctx->notification_ctx, uuid, _r.v.v1.count, _r.v.v1.subscription);
 
 end:
 	talloc_free(mem_ctx);
@@ -769,6 +888,304 @@ static enum mapistore_error mapistore_notification_subscription_set_key(TALLOC_C
 }
 
 
+/**
+   \details Unpack a subscription record
+
+   \param mem_ctx pointer to the memory context
+   \param blob pointer to the record value
+   \param r pointer to the subscription structure to return
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_notification_subscription_unpack(TALLOC_CTX *mem_ctx,
+								       DATA_BLOB *blob,
+								       struct mapistore_notification_subscription *r)
+{
+	struct ndr_pull		*ndr;
+	enum ndr_err_code	ndr_err_code;
+
+	ndr = ndr_pull_init_blob(blob, mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+
+	ndr_err_code = ndr_pull_mapistore_notification_subscription(ndr, NDR_SCALARS, r);
+	talloc_free(ndr);
+	MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERROR, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   Subscriptions of the sessions served by this process.
+
+   Subscriptions are only added and removed by the emsmdb process
+   serving the session, so once this process has written the record
+   of a session, its own copy is as recent as memcached and lookups
+   skip the round-trip and the decoding of the whole record. Records
+   only read from memcached are not kept: another process may update
+   them.
+
+   The flags and FolderID of the subscriptions are kept apart from
+   the subscriptions, so a lookup scans 16 bytes per subscription and
+   only copies the matching ones with their properties.
+ */
+struct mapistore_notification_local_key {
+	uint64_t	fid;
+	uint16_t	flags;
+};
+
+struct mapistore_notification_local {
+	struct mapistore_notification_local		*prev;
+	struct mapistore_notification_local		*next;
+	struct GUID					uuid;
+	size_t						hash;
+	uint32_t					count;
+	struct mapistore_notification_local_key		*keys;
+	struct subscription_object_v1			*subscription;
+};
+
+static size_t mapistore_notification_local_rehash(const void *e, void *unused)
+{
+	return ((const struct mapistore_notification_local *)e)->hash;
+}
+
+/* Most recently used first */
+static struct mapistore_notification_local	*local_subscriptions = NULL;
+static uint32_t					local_subscriptions_count = 0;
+static struct htable				local_subscriptions_ht = HTABLE_INITIALIZER(local_subscriptions_ht, mapistore_notification_local_rehash, NULL);
+
+
+static struct mapistore_notification_local *mapistore_notification_local_find(struct GUID uuid, size_t h)
+{
+	struct mapistore_notification_local	*entry;
+	struct htable_iter			iter;
+
+	for (entry = htable_firstval(&local_subscriptions_ht, &iter, h); entry;
+	     entry = htable_nextval(&local_subscriptions_ht, &iter, h)) {
+		if (GUID_equal(&entry->uuid, &uuid)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void mapistore_notification_local_remove(struct mapistore_notification_local *entry)
+{
+	htable_del(&local_subscriptions_ht, entry->hash, entry);
+	DLIST_REMOVE(local_subscriptions, entry);
+	talloc_free(entry);
+	local_subscriptions_count--;
+}
+
+
+/**
+   \details Forget the subscriptions of a session kept in process
+   memory
+
+   \param uuid the session UUID
+ */
+static void mapistore_notification_local_forget(struct GUID uuid)
+{
+	struct mapistore_notification_local	*entry;
+
+	entry = mapistore_notification_local_find(uuid, hash(&uuid, 1, 0));
+	if (entry) {
+		mapistore_notification_local_remove(entry);
+	}
+}
+
+
+/**
+   \details Keep in process memory the subscriptions of a session
+   this process has just written to memcached
+
+   \param notification_ctx pointer to the notification context
+   \param uuid the session UUID
+   \param count number of subscriptions
+   \param subscription array of subscriptions of the session
+ */
+static void mapistore_notification_local_set(struct mapistore_notification_context *notification_ctx,
+					     struct GUID uuid, uint32_t count,
+					     const struct subscription_object_v1 *subscription)
+{
+	struct mapistore_notification_local	*entry;
+	size_t					h;
+	uint32_t				i;
+
+	if (!notification_ctx->local_subscriptions) return;
+
+	h = hash(&uuid, 1, 0);
+	entry = mapistore_notification_local_find(uuid, h);
+	if (entry) {
+		mapistore_notification_local_remove(entry);
+	} else if (local_subscriptions_count >= MSTORE_LOCAL_SUBSCRIPTIONS_MAX) {
+		mapistore_notification_local_remove(DLIST_TAIL(local_subscriptions));
+	}
+	if (!count) return;
+
+	entry = talloc_zero(NULL, struct mapistore_notification_local);
+	if (!entry) return;
+	entry->uuid = uuid;
+	entry->hash = h;
+	entry->count = count;
+	entry->keys = talloc_array(entry, struct mapistore_notification_local_key, count);
+	entry->subscription = talloc_array(entry, struct subscription_object_v1, count);
+	if (!entry->keys || !entry->subscription) {
+		talloc_free(entry);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		entry->keys[i].fid = subscription[i].fid;
+		entry->keys[i].flags = subscription[i].flags;
+		entry->subscription[i] = subscription[i];
+		entry->subscription[i].properties = NULL;
+		if (subscription[i].count) {
+			entry->subscription[i].properties = (uint32_t *) talloc_memdup(entry->subscription, subscription[i].properties,
+										      subscription[i].count * sizeof (uint32_t));
+			if (!entry->subscription[i].properties) {
+				talloc_free(entry);
+				return;
+			}
+		}
+	}
+
+	if (!htable_add(&local_subscriptions_ht, h, entry)) {
+		talloc_free(entry);
+		return;
+	}
+	DLIST_ADD(local_subscriptions, entry);
+	local_subscriptions_count++;
+}
+
+
+/**
+   \details Check if a subscription matches an event
+
+   \param flags the flags of the subscription
+   \param fid the FolderID of the subscription
+   \param mask the notification bitmask of the event, 0 for any event
+   \param folderId the folder of the event, 0 for any folder
+
+   \return true if the subscription matches, otherwise false
+ */
+static bool mapistore_notification_subscription_match(uint16_t flags, uint64_t fid,
+						      uint16_t mask, uint64_t folderId)
+{
+	if (mask && !(flags & mask)) return false;
+	if (folderId && !(flags & sub_WholeStore) && fid != folderId) return false;
+
+	return true;
+}
+
+
+/**
+   \details Copy the subscriptions matching an event
+
+   \param mem_ctx pointer to the memory context
+   \param keys the flags and FolderID of the subscriptions, NULL to
+   read them from the subscriptions
+   \param subscription array of subscriptions
+   \param count number of subscriptions
+   \param mask the notification bitmask of the event, 0 for any event
+   \param folderId the folder of the event, 0 for any folder
+   \param r pointer to the subscription structure to return
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if no
+   subscription matches, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_notification_subscription_filter(TALLOC_CTX *mem_ctx,
+								       const struct mapistore_notification_local_key *keys,
+								       const struct subscription_object_v1 *subscription,
+								       uint32_t count, uint16_t mask, uint64_t folderId,
+								       struct mapistore_notification_subscription *r)
+{
+	struct subscription_object_v1	*matches = NULL;
+	uint32_t			i;
+	uint32_t			n = 0;
+	bool				match;
+
+	for (i = 0; i < count; i++) {
+		if (keys) {
+			match = mapistore_notification_subscription_match(keys[i].flags, keys[i].fid, mask, folderId);
+		} else {
+			match = mapistore_notification_subscription_match(subscription[i].flags, subscription[i].fid,
+									  mask, folderId);
+		}
+		if (!match) continue;
+
+		if (!matches) {
+			matches = talloc_array(mem_ctx, struct subscription_object_v1, count - i);
+			MAPISTORE_RETVAL_IF(!matches, MAPISTORE_ERR_NO_MEMORY, NULL);
+		}
+		matches[n] = subscription[i];
+		matches[n].properties = NULL;
+		if (subscription[i].count) {
+			matches[n].properties = (uint32_t *) talloc_memdup(matches, subscription[i].properties,
+									   subscription[i].count * sizeof (uint32_t));
+			MAPISTORE_RETVAL_IF(!matches[n].properties, MAPISTORE_ERR_NO_MEMORY, matches);
+		}
+		n++;
+	}
+	MAPISTORE_RETVAL_IF(!n, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	r->vnum = 1;
+	r->v.v1.count = n;
+	r->v.v1.subscription = matches;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the record of subscriptions of a session from
+   memcached
+
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param uuid the UUID session to lookup
+   \param _r pointer to the mapistore_notification_subscription to return
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_notification_subscription_load(TALLOC_CTX *mem_ctx,
+								     struct mapistore_context *mstore_ctx,
+								     struct GUID uuid,
+								     struct mapistore_notification_subscription *_r)
+{
+	TALLOC_CTX					*local_mem_ctx;
+	enum mapistore_error				retval;
+	DATA_BLOB					blob;
+	struct mapistore_notification_subscription	r;
+	char						*key;
+	uint64_t					cas;
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* Retrieve key/value */
+	retval = mapistore_notification_subscription_set_key(local_mem_ctx, uuid, &key);
+	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
+
+	retval = mapistore_notification_fetch(local_mem_ctx, mstore_ctx->notification_ctx->memc_ctx,
+					      key, &blob, &cas);
+	talloc_free(key);
+	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
+
+	/* Unpack subscription structure */
+	retval = mapistore_notification_subscription_unpack(mem_ctx, &blob, &r);
+	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
+
+	*_r = r;
+
+	talloc_free(local_mem_ctx);
+	return MAPISTORE_SUCCESS;
+}
+
+
 /**
    \details Retrieve all the subscriptions associated to a uuid
 
@@ -787,17 +1204,7 @@ enum mapistore_error mapistore_notification_subscription_get(TALLOC_CTX *mem_ctx
 							     struct GUID uuid,
 							     struct mapistore_notification_subscription *_r)
 {
-	TALLOC_CTX					*local_mem_ctx;
-	enum mapistore_error				retval;
-	enum ndr_err_code				ndr_err_code;
-	struct ndr_pull					*ndr;
-	DATA_BLOB					blob;
-	struct mapistore_notification_subscription	r;
-	char						*key;
-	char						*value = NULL;
-	size_t						value_len = 0;
-	memcached_return_t				rc;
-	uint32_t					flags;
+	struct mapistore_notification_local	*entry;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -805,36 +1212,72 @@ enum mapistore_error mapistore_notification_subscription_get(TALLOC_CTX *mem_ctx
 	MAPISTORE_RETVAL_IF(!mstore_ctx->notification_ctx, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
 	MAPISTORE_RETVAL_IF(!mstore_ctx->notification_ctx->memc_ctx, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
 
-	local_mem_ctx = talloc_new(NULL);
-	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+	entry = mapistore_notification_local_find(uuid, hash(&uuid, 1, 0));
+	if (entry) {
+		DLIST_PROMOTE(local_subscriptions, entry);
+		return mapistore_notification_subscription_filter(mem_ctx, entry->keys, entry->subscription,
+								  entry->count, 0, 0, _r);
+	}
 
-	/* Retrieve key/value */
-	retval = mapistore_notification_subscription_set_key(local_mem_ctx, uuid, &key);
-	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
+	return mapistore_notification_subscription_load(mem_ctx, mstore_ctx, uuid, _r);
+}
 
-	value = memcached_get(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key), &value_len,
-			      &flags, &rc);
-	talloc_free(key);
-	MAPISTORE_RETVAL_IF(!value, ret_to_mapistore(rc), local_mem_ctx);
 
-	/* Unpack subscription structure */
-	blob.data = talloc_memdup(local_mem_ctx, (uint8_t *) value, value_len);
-	free(value);
-	MAPISTORE_RETVAL_IF(!blob.data, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
-	blob.length = value_len;
+/**
+   \details Retrieve the subscriptions of a session matching an event
 
-	ndr = ndr_pull_init_blob(&blob, mem_ctx);
-	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
-	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param uuid the UUID session to lookup
+   \param flags the notification bitmask of the event: subscriptions
+   with none of these flags are skipped. 0 matches any event
+   \param fid the folder of the event: subscriptions on another folder
+   and not on the whole store are skipped. 0 matches any folder
+   \param _r pointer to the mapistore_notification_subscription to return
 
-	ndr_err_code = ndr_pull_mapistore_notification_subscription(ndr, NDR_SCALARS, &r);
-	talloc_free(ndr);
-	MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERROR, local_mem_ctx);
+   \note the caller is responsible for freeing memory associated to
+   mapistore_notification_subscription
 
-	*_r = r;
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if no
+   subscription matches, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_notification_subscription_find(TALLOC_CTX *mem_ctx,
+							      struct mapistore_context *mstore_ctx,
+							      struct GUID uuid,
+							      uint16_t flags,
+							      uint64_t fid,
+							      struct mapistore_notification_subscription *_r)
+{
+	TALLOC_CTX					*local_mem_ctx;
+	struct mapistore_notification_local		*entry;
+	struct mapistore_notification_subscription	r;
+	enum mapistore_error				retval;
 
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!_r, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!mstore_ctx->notification_ctx, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+	MAPISTORE_RETVAL_IF(!mstore_ctx->notification_ctx->memc_ctx, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	entry = mapistore_notification_local_find(uuid, hash(&uuid, 1, 0));
+	if (entry) {
+		DLIST_PROMOTE(local_subscriptions, entry);
+		return mapistore_notification_subscription_filter(mem_ctx, entry->keys, entry->subscription,
+								  entry->count, flags, fid, _r);
+	}
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	retval = mapistore_notification_subscription_load(local_mem_ctx, mstore_ctx, uuid, &r);
+	MAPISTORE_RETVAL_IF(retval, retval, local_mem_ctx);
+	MAPISTORE_RETVAL_IF(r.vnum != 1, MAPISTORE_ERR_INVALID_DATA, local_mem_ctx);
+
+	retval = mapistore_notification_subscription_filter(mem_ctx, NULL, r.v.v1.subscription,
+							    r.v.v1.count, flags, fid, _r);
 	talloc_free(local_mem_ctx);
-	return MAPISTORE_SUCCESS;
+
+	return retval;
 }
 
 
@@ -870,7 +1313,12 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_add(struct map
 	enum ndr_err_code				ndr_err_code;
 	memcached_return				rc = MEMCACHED_ERROR;
 	char						*key = NULL;
-
+	DATA_BLOB					blob;
+	uint64_t					cas = 0;
+	bool						exist;
+	uint32_t					i;
+	uint32_t					last;
+	int						retry;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -885,32 +1333,38 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_add(struct map
 	retval = mapistore_notification_subscription_set_key(mem_ctx, uuid, &key);
 	MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
 
-	/* Create subscription v1 blob */
-	ndr = ndr_push_init_ctx(mem_ctx);
-	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-	ndr->offset = 0;
-
-	retval = mapistore_notification_subscription_exist(mstore_ctx, uuid);
-	if (retval == MAPISTORE_SUCCESS) {
-		uint32_t	i = 0;
-		uint32_t	last = 0;
-
-		retval = mapistore_notification_subscription_get(mem_ctx, mstore_ctx, uuid, &r);
-		MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
-
-		/* Check if the subscription does not already exist */
-		for (i = 0; i < r.v.v1.count; i++) {
-			if (r.v.v1.subscription[i].handle == handle) {
-				OC_DEBUG(0, "subscription with handle=0x%x already exist", handle);
-				talloc_free(mem_ctx);
-				return MAPISTORE_ERR_EXIST;
+	for (retry = 0; retry < MSTORE_MEMC_CAS_RETRY; retry++) {
+		retval = mapistore_notification_fetch(mem_ctx, mstore_ctx->notification_ctx->memc_ctx,
+						      key, &blob, &cas);
+		if (retval == MAPISTORE_SUCCESS) {
+			exist = true;
+			retval = mapistore_notification_subscription_unpack(mem_ctx, &blob, &r);
+			MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
+
+			/* Check if the subscription does not already exist */
+			for (i = 0; i < r.v.v1.count; i++) {
+				if (r.v.v1.subscription[i].handle == handle) {
+					OC_DEBUG(0, "subscription with handle=0x%x already exist", handle);
+					talloc_free(mem_ctx);
+					return MAPISTORE_ERR_EXIST;
+				}
 			}
+
+			r.v.v1.subscription = talloc_realloc(mem_ctx, r.v.v1.subscription, struct subscription_object_v1,
+							     r.v.v1.count + 1);
+			MAPISTORE_RETVAL_IF(!r.v.v1.subscription, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		} else if (retval == MAPISTORE_ERR_NOT_FOUND) {
+			exist = false;
+			r.v.v1.count = 0;
+			r.v.v1.subscription = talloc_array(mem_ctx, struct subscription_object_v1, 1);
+			MAPISTORE_RETVAL_IF(!r.v.v1.subscription, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		} else {
+			MAPISTORE_RETVAL_ERR(retval, mem_ctx);
 		}
 
 		r.vnum = 1;
 		last = r.v.v1.count;
 		r.v.v1.count = r.v.v1.count + 1;
-		r.v.v1.subscription = talloc_realloc(mem_ctx, r.v.v1.subscription, struct subscription_object_v1, r.v.v1.count + 1);
 		r.v.v1.subscription[last].handle = handle;
 		r.v.v1.subscription[last].flags = flags;
 		r.v.v1.subscription[last].fid = fid;
@@ -918,34 +1372,22 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_add(struct map
 		r.v.v1.subscription[last].count = count;
 		r.v.v1.subscription[last].properties = (uint32_t *)properties;
 
-		ndr_err_code = ndr_push_mapistore_notification_subscription(ndr, NDR_SCALARS, &r);
-		MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, mem_ctx);
-
-		/* Add the key/value record */
-		rc = memcached_set(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
-				   (char *) ndr->data, ndr->offset, 0, 0);
-
-	} else {
-		r.vnum = 1;
-		r.v.v1.count = 1;
-		r.v.v1.subscription = talloc_array(mem_ctx, struct subscription_object_v1, 1);
-		MAPISTORE_RETVAL_IF(!r.v.v1.subscription, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-		r.v.v1.subscription[0].handle = handle;
-		r.v.v1.subscription[0].flags = flags;
-		r.v.v1.subscription[0].fid = fid;
-		r.v.v1.subscription[0].mid = mid;
-		r.v.v1.subscription[0].count = count;
-		r.v.v1.subscription[0].properties = (uint32_t *)properties;
+		/* Create subscription v1 blob */
+		ndr = ndr_push_init_ctx(mem_ctx);
+		MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+		ndr->offset = 0;
 
 		ndr_err_code = ndr_push_mapistore_notification_subscription(ndr, NDR_SCALARS, &r);
 		MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, mem_ctx);
 
-		/* Add the key/value record */
-		rc = memcached_add(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
-				   (char *)ndr->data, ndr->offset, 0, 0);
+		/* Add or update the key/value record */
+		rc = mapistore_notification_store(mstore_ctx->notification_ctx->memc_ctx, key, ndr, exist, cas);
+		if (!mapistore_notification_store_conflict(rc)) break;
+		OC_DEBUG(5, "subscription record '%s' modified concurrently, retrying", key);
 	}
 
 	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
+	mapistore_notification_local_set(mstore_ctx->notification_ctx, uuid, r.v.v1.count, r.v.v1.subscription);
 	talloc_free(mem_ctx);
 
 	return MAPISTORE_SUCCESS;
@@ -1017,6 +1459,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_delete(struct
 	MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
 
 	/* Delete the key */
+	mapistore_notification_local_forget(uuid);
 	rc = memcached_delete(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key), 0);
 	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
 
@@ -1058,7 +1501,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_delete_by_hand
 	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
 
 	/* Get the record */
-	retval = mapistore_notification_subscription_get(mem_ctx, mstore_ctx, uuid, &r);
+	retval = mapistore_notification_subscription_load(mem_ctx, mstore_ctx, uuid, &r);
 	MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
 
 	for (i = 0; i < r.v.v1.count; i++) {
@@ -1075,6 +1518,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_delete_by_hand
 
 	/* If we only have one entry left, delete the record */
 	if (r.v.v1.count == 1) {
+		mapistore_notification_local_forget(uuid);
 		rc = memcached_delete(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key), 0);
 		MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
 		goto end;
@@ -1103,6 +1547,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_subscription_delete_by_hand
 	rc = memcached_set(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
 			   (char *)ndr->data, ndr->offset, 0, 0);
 	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
+	mapistore_notification_local_set(mstore_ctx->notification_ctx, uuid, _r.v.v1.count, _r.v.v1.subscription);
 
 end:
 	talloc_free(mem_ctx);
@@ -1158,7 +1603,8 @@ _PUBLIC_ enum mapistore_error mapistore_notification_deliver_add(struct mapistor
 	TALLOC_CTX		*mem_ctx;
 	enum mapistore_error	retval;
 	char			*key = NULL;
-	memcached_return	rc;
+	memcached_return	rc = MEMCACHED_ERROR;
+	int			retry;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -1174,17 +1620,16 @@ _PUBLIC_ enum mapistore_error mapistore_notification_deliver_add(struct mapistor
 	retval = mapistore_notification_deliver_set_key(mem_ctx, uuid, &key);
 	MAPISTORE_RETVAL_IF(retval, retval, mem_ctx);
 
-	/* Create deliver v1 blob */
-	retval = mapistore_notification_deliver_exist(mstore_ctx, uuid);
-	if (retval == MAPISTORE_SUCCESS) {
-		/* Update the key/value record */
+	/* Append to the existing record, create it if there is none yet
+	   and try again if it was created by another instance meanwhile */
+	for (retry = 0; retry < MSTORE_MEMC_CAS_RETRY; retry++) {
 		rc = memcached_append(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
-				   (char *) payload, length, 0, 0);
+				      (char *) payload, length, 0, 0);
+		if (rc != MEMCACHED_NOTSTORED) break;
 
-	} else {
-		/* Add the key/value record */
 		rc = memcached_add(mstore_ctx->notification_ctx->memc_ctx, key, strlen(key),
 				   (char *)payload, length, 0, 0);
+		if (rc != MEMCACHED_NOTSTORED) break;
 	}
 
 	MAPISTORE_RETVAL_IF(rc != MEMCACHED_SUCCESS, ret_to_mapistore(rc), mem_ctx);
@@ -1317,11 +1762,122 @@ _PUBLIC_ enum mapistore_error mapistore_notification_deliver_delete(struct mapis
 	return MAPISTORE_SUCCESS;
 }
 
+/**
+   \details Create a batch grouping the deliver payloads generated
+   for a single event
+
+   Payloads added to the batch are kept in memory and concatenated per
+   session, so that mapistore_notification_batch_commit publishes them
+   on the notification bus once per session instead of once per
+   payload.
+
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param batchp pointer on pointer to the batch to return
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_batch_init(TALLOC_CTX *mem_ctx,
+								struct mapistore_context *mstore_ctx,
+								struct mapistore_notification_batch **batchp)
+{
+	struct mapistore_notification_batch	*batch;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!batchp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	batch = talloc_zero(mem_ctx, struct mapistore_notification_batch);
+	MAPISTORE_RETVAL_IF(!batch, MAPISTORE_ERR_NO_MEMORY, NULL);
+	batch->mstore_ctx = mstore_ctx;
+
+	*batchp = batch;
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Queue a deliver payload in a batch
+
+   \param batch pointer to the batch
+   \param uuid the session UUID
+   \param payload the payload data to add to the key
+   \param length the length of the payload data
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_batch_deliver_add(struct mapistore_notification_batch *batch,
+								       struct GUID uuid, uint8_t *payload,
+								       size_t length)
+{
+	struct mapistore_notification_batch_entry	*entry;
+	uint8_t						*data;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!batch, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!payload, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!length, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	for (entry = batch->entries; entry; entry = entry->next) {
+		if (GUID_equal(&entry->uuid, &uuid)) break;
+	}
+
+	if (!entry) {
+		entry = talloc_zero(batch, struct mapistore_notification_batch_entry);
+		MAPISTORE_RETVAL_IF(!entry, MAPISTORE_ERR_NO_MEMORY, NULL);
+		entry->uuid = uuid;
+		DLIST_ADD_END(batch->entries, entry, struct mapistore_notification_batch_entry *);
+	}
+
+	data = talloc_realloc(entry, entry->payload.data, uint8_t, entry->payload.length + length);
+	MAPISTORE_RETVAL_IF(!data, MAPISTORE_ERR_NO_MEMORY, NULL);
+	memcpy(data + entry->payload.length, payload, length);
+	entry->payload.data = data;
+	entry->payload.length += length;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Publish the payloads queued in a batch and empty it
+
+   \param batch pointer to the batch
+
+   \return MAPISTORE_SUCCESS on success, otherwise the error of the
+   last write that failed
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_batch_commit(struct mapistore_notification_batch *batch)
+{
+	struct mapistore_notification_batch_entry	*entry;
+	enum mapistore_error				retval = MAPISTORE_SUCCESS;
+	enum mapistore_error				ret;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!batch, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+
+	while ((entry = batch->entries) != NULL) {
+		ret = mapistore_notification_bus_publish(batch->mstore_ctx, entry->uuid,
+							 entry->payload.data, entry->payload.length);
+		if (ret != MAPISTORE_SUCCESS) {
+			OC_DEBUG(0, "Unable to deliver %zu bytes of notifications: %s",
+				 entry->payload.length, mapistore_errstr(ret));
+			retval = ret;
+		}
+		DLIST_REMOVE(batch->entries, entry);
+		talloc_free(entry);
+	}
+
+	return retval;
+}
+
+
 /**
    \details Generate a newmail notification payload to be consumed by
    the service referenced by resolver entries.
 
    \param mem_ctx pointer to the memory context
+   \param cn the resolver key of the user the notification is for
    \param backend the mapistore backend consuming this url
    \param eml the eml message to index
    \param folder the destination folder
@@ -1332,6 +1888,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_deliver_delete(struct mapis
    \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE_ERROR
  */
 _PUBLIC_ enum mapistore_error mapistore_notification_payload_newmail(TALLOC_CTX *mem_ctx,
+								     char *cn,
 								     char *backend,
 								     char *eml,
 								     char *folder,
@@ -1344,6 +1901,7 @@ _PUBLIC_ enum mapistore_error mapistore_notification_payload_newmail(TALLOC_CTX
 	enum ndr_err_code		ndr_err_code;
 
 	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!cn, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!backend, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!eml, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 	MAPISTORE_RETVAL_IF(!folder, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
@@ -1354,12 +1912,13 @@ _PUBLIC_ enum mapistore_error mapistore_notification_payload_newmail(TALLOC_CTX
 	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
 	ndr->offset = 0;
 
-	r.vnum = 1;
-	r.v.v1.flags = sub_NewMail;
-	r.v.v1.u.newmail.backend = backend;
-	r.v.v1.u.newmail.eml = eml;
-	r.v.v1.u.newmail.folder = folder;
-	r.v.v1.u.newmail.separator = separator;
+	r.vnum = MAPISTORE_NOTIFICATION_V2;
+	r.v.v2.cn = cn;
+	r.v.v2.flags = sub_NewMail;
+	r.v.v2.u.newmail.backend = backend;
+	r.v.v2.u.newmail.eml = eml;
+	r.v.v2.u.newmail.folder = folder;
+	r.v.v2.u.newmail.separator = separator;
 
 	ndr_err_code = ndr_push_mapistore_notification(ndr, NDR_SCALARS, &r);
 	MAPISTORE_RETVAL_IF(ndr_err_code != NDR_ERR_SUCCESS, MAPISTORE_ERR_INVALID_DATA, ndr);
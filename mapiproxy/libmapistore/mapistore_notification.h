@@ -29,10 +29,61 @@
 
 #define	MSTORE_MEMC_DFLT_HOST	"127.0.0.1"
 
+/* Number of attempts for a read-modify-write cycle before giving up */
+#define	MSTORE_MEMC_CAS_RETRY	5
+
 /* Define format strings used for key storage in memcached */
 #define	MSTORE_MEMC_FMT_SESSION	"session:%s"
 #define	MSTORE_MEMC_FMT_RESOLVER "resolver:%s"
 #define	MSTORE_MEMC_FMT_SUBSCRIPTION "subscription:%s"
 #define	MSTORE_MEMC_FMT_DELIVER "deliver:%s"
 
+/* Sessions whose subscriptions are kept in process memory */
+#define	MSTORE_LOCAL_SUBSCRIPTIONS_MAX	1024
+
+/* Notification bus used when mapistore:notification_bus is not set */
+#define	MSTORE_BUS_DFLT		"memcached"
+
+/* Shard of the nodes when mailboxes are not sharded */
+#define	MSTORE_BUS_DFLT_SHARD	"default"
+
+/* Resolver entry listing the subscribers of a shard */
+#define	MSTORE_BUS_FMT_RESOLVER	"bus:%s"
+
+/* Seconds the subscribers of a shard are cached by publishers */
+#define	MSTORE_BUS_REFRESH	30
+
+/* Messages read from the bus in a single pass */
+#define	MSTORE_BUS_RECV_MAX	64
+
+struct mapistore_notification_bus;
+
+/**
+   Operations implemented by a notification bus.
+
+   Deliveries are published for the emsmdb session they are addressed
+   to and fetched by the process hosting this session. subscribe and
+   unsubscribe bracket the life of a session on the fetching side;
+   refresh tells the publishing side that new subscribers may have
+   joined. Optional operations are left NULL.
+ */
+struct mapistore_notification_bus_ops {
+	const char		*name;
+	enum mapistore_error	(*init)(struct mapistore_notification_bus *, struct loadparm_context *);
+	enum mapistore_error	(*subscribe)(struct mapistore_notification_bus *, struct mapistore_context *, struct GUID);
+	enum mapistore_error	(*unsubscribe)(struct mapistore_notification_bus *, struct mapistore_context *, struct GUID);
+	enum mapistore_error	(*publish)(struct mapistore_notification_bus *, struct mapistore_context *, struct GUID, const uint8_t *, size_t);
+	enum mapistore_error	(*fetch)(TALLOC_CTX *, struct mapistore_notification_bus *, struct mapistore_context *, struct GUID, uint8_t **, size_t *);
+	enum mapistore_error	(*refresh)(struct mapistore_notification_bus *, struct mapistore_context *);
+};
+
+struct mapistore_notification_bus {
+	const struct mapistore_notification_bus_ops	*ops;
+	struct loadparm_context				*lp_ctx;
+	void						*private_data;
+};
+
+/* definitions from mapistore_notification_bus.c */
+enum mapistore_error mapistore_notification_bus_init(TALLOC_CTX *, struct loadparm_context *, struct mapistore_notification_bus **);
+
 #endif /* MAPISTORE_NOTIFICATION_H */
@@ -0,0 +1,883 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_notification_bus.c
+
+   \brief Delivery of the notification blobs to the emsmdb sessions
+
+   asyncemsmdb generates the Notify blobs of a session and emsmdb
+   returns them with the next EcDoRpc call of this session, possibly
+   on another node. The bus carrying them is selected with
+   mapistore:notification_bus:
+
+   - memcached (default): blobs are appended to a deliver record of
+     the session, which emsmdb reads and deletes on every EcDoRpc call
+     with notifications.
+
+   - nanomsg: every process hosting emsmdb sessions binds a single SUB
+     socket, registers it once in the resolver entry of its shard and
+     subscribes to the uuid of its sessions. Publishers connect a PUB
+     socket per shard to the registered subscribers and push the blobs,
+     prefixed with the session uuid, to the shard owning the mailbox;
+     emsmdb then picks them from its socket without any memcached
+     round-trip. Messages published while nobody listens are lost, as
+     with any PUB/SUB bus.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <nanomsg/nn.h>
+#include <nanomsg/pubsub.h>
+
+#include "mapiproxy/libmapistore/mapistore_notification.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "utils/dlinklist.h"
+
+/* Length of the session uuid prefixing messages on the nanomsg bus */
+#define	BUS_NANOMSG_TOPIC_LEN	16
+
+#define	BUS_NANOMSG_FALLBACK_ADDR	"127.0.0.1"
+
+struct bus_nanomsg_subscription {
+	struct GUID				uuid;
+	DATA_BLOB				pending;
+	struct bus_nanomsg_subscription		*prev;
+	struct bus_nanomsg_subscription		*next;
+};
+
+struct bus_nanomsg_shard {
+	char				*name;
+	int				sock;
+	uint32_t			count;
+	char				**hosts;
+	int				*endpoints;
+	time_t				loaded;
+	struct bus_nanomsg_shard	*prev;
+	struct bus_nanomsg_shard	*next;
+};
+
+struct bus_nanomsg {
+	pid_t					pid;
+	const char				*listen;
+	int					refresh;
+	int					sock;
+	char					*bind_addr;
+	char					*resolver_cn;
+	bool					registered;
+	struct bus_nanomsg_subscription		*subscriptions;
+	struct bus_nanomsg_shard		*shards;
+};
+
+
+/**
+   \details Publish a blob for a session in its deliver record
+ */
+static enum mapistore_error bus_memcached_publish(struct mapistore_notification_bus *bus,
+						  struct mapistore_context *mstore_ctx,
+						  struct GUID uuid, const uint8_t *payload,
+						  size_t length)
+{
+	return mapistore_notification_deliver_add(mstore_ctx, uuid, (uint8_t *) payload, length);
+}
+
+
+/**
+   \details Read and clear the deliver record of a session
+ */
+static enum mapistore_error bus_memcached_fetch(TALLOC_CTX *mem_ctx,
+						struct mapistore_notification_bus *bus,
+						struct mapistore_context *mstore_ctx,
+						struct GUID uuid, uint8_t **payload,
+						size_t *length)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_notification_deliver_get(mem_ctx, mstore_ctx, uuid, payload, length);
+	MAPISTORE_RETVAL_IF(retval, retval, NULL);
+
+	retval = mapistore_notification_deliver_delete(mstore_ctx, uuid);
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "Unable to delete notification key: %s", mapistore_errstr(retval));
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+static const struct mapistore_notification_bus_ops bus_memcached_ops = {
+	.name		= "memcached",
+	.publish	= bus_memcached_publish,
+	.fetch		= bus_memcached_fetch,
+};
+
+
+/**
+   \details Return an available port to bind the SUB socket on
+
+   \return port > 0 on success, otherwise -1
+ */
+static int bus_nanomsg_random_port(void)
+{
+	int			sockfd;
+	struct sockaddr_in	addr;
+	socklen_t		addr_len;
+	uint16_t		port;
+
+	sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sockfd == -1) return -1;
+
+	memset(&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = INADDR_ANY;
+	addr.sin_port = htons(0);
+	if (bind(sockfd, (struct sockaddr *) &addr, sizeof (addr)) == -1) {
+		close(sockfd);
+		return -1;
+	}
+
+	addr_len = sizeof (addr);
+	if (getsockname(sockfd, (struct sockaddr *) &addr, &addr_len) == -1) {
+		close(sockfd);
+		return -1;
+	}
+
+	port = ntohs(addr.sin_port);
+	close(sockfd);
+
+	return port;
+}
+
+
+static int bus_nanomsg_shard_destructor(void *data)
+{
+	struct bus_nanomsg_shard	*shard = (struct bus_nanomsg_shard *) data;
+
+	if (shard->sock != -1) {
+		nn_close(shard->sock);
+	}
+
+	return 0;
+}
+
+
+static int bus_nanomsg_destructor(void *data)
+{
+	struct bus_nanomsg	*state = (struct bus_nanomsg *) data;
+
+	/* Sockets inherited from the parent process belong to the parent */
+	if (state->pid != getpid()) return 0;
+
+	if (state->sock != -1) {
+		nn_close(state->sock);
+	}
+
+	return 0;
+}
+
+
+/**
+   \details Return the shard served by this node
+
+   \param bus pointer to the notification bus
+
+   \return the name of the shard
+ */
+static const char *bus_nanomsg_local_shard(struct mapistore_notification_bus *bus)
+{
+	const struct mapiproxy_shard_ring	*ring;
+
+	ring = mapiproxy_shard_ring_get(bus->lp_ctx);
+	if (!ring || !ring->local) return MSTORE_BUS_DFLT_SHARD;
+
+	return ring->local;
+}
+
+
+/**
+   \details Return the shard owning the mailbox of the user a
+   mapistore context was opened for
+
+   \param bus pointer to the notification bus
+   \param mstore_ctx pointer to the mapistore context
+
+   \return the name of the shard
+ */
+static const char *bus_nanomsg_owner_shard(struct mapistore_notification_bus *bus,
+					   struct mapistore_context *mstore_ctx)
+{
+	const struct mapiproxy_shard_ring	*ring;
+	const char				*node;
+
+	ring = mapiproxy_shard_ring_get(bus->lp_ctx);
+	if (!ring) return MSTORE_BUS_DFLT_SHARD;
+
+	if (mstore_ctx->conn_info && mstore_ctx->conn_info->username) {
+		node = mapiproxy_shard_ring_lookup(ring, mstore_ctx->conn_info->username);
+		if (node) return node;
+	}
+
+	return ring->local ? ring->local : MSTORE_BUS_DFLT_SHARD;
+}
+
+
+/**
+   \details Return the state of the bus in the current process,
+   starting afresh after a fork
+ */
+static struct bus_nanomsg *bus_nanomsg_state(struct mapistore_notification_bus *bus)
+{
+	struct bus_nanomsg	*state = (struct bus_nanomsg *) bus->private_data;
+	struct bus_nanomsg	*fresh;
+
+	if (state->pid == getpid()) return state;
+
+	fresh = talloc_zero(bus, struct bus_nanomsg);
+	if (!fresh) return NULL;
+	fresh->pid = getpid();
+	fresh->listen = state->listen;
+	fresh->refresh = state->refresh;
+	fresh->sock = -1;
+	talloc_set_destructor((void *)fresh, (int (*)(void *))bus_nanomsg_destructor);
+
+	/* The shard sockets of the parent must not be closed either */
+	while (state->shards) {
+		struct bus_nanomsg_shard	*shard = state->shards;
+
+		DLIST_REMOVE(state->shards, shard);
+		talloc_set_destructor(shard, NULL);
+		talloc_free(shard);
+	}
+	talloc_free(state);
+
+	bus->private_data = fresh;
+	return fresh;
+}
+
+
+static enum mapistore_error bus_nanomsg_init(struct mapistore_notification_bus *bus,
+					     struct loadparm_context *lp_ctx)
+{
+	struct bus_nanomsg	*state;
+
+	state = talloc_zero(bus, struct bus_nanomsg);
+	MAPISTORE_RETVAL_IF(!state, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	state->pid = getpid();
+	state->sock = -1;
+	state->listen = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "notification_bus_listen");
+	if (!state->listen) {
+		state->listen = BUS_NANOMSG_FALLBACK_ADDR;
+	}
+	state->refresh = lpcfg_parm_int(lp_ctx, NULL, "mapistore", "notification_bus_refresh", MSTORE_BUS_REFRESH);
+	if (state->refresh < 0) {
+		state->refresh = 0;
+	}
+	talloc_set_destructor((void *)state, (int (*)(void *))bus_nanomsg_destructor);
+
+	bus->private_data = state;
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Bind the SUB socket of the process on first use
+
+   \param bus pointer to the notification bus
+   \param state pointer to the state of the bus in this process
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error bus_nanomsg_listen(struct mapistore_notification_bus *bus,
+					       struct bus_nanomsg *state)
+{
+	int	port;
+
+	if (state->sock != -1) return MAPISTORE_SUCCESS;
+
+	port = bus_nanomsg_random_port();
+	MAPISTORE_RETVAL_IF(port == -1, MAPISTORE_ERR_CONN_REFUSED, NULL);
+
+	state->bind_addr = talloc_asprintf(state, "tcp://%s:%d", state->listen, port);
+	state->resolver_cn = talloc_asprintf(state, MSTORE_BUS_FMT_RESOLVER, bus_nanomsg_local_shard(bus));
+	MAPISTORE_RETVAL_IF(!state->bind_addr || !state->resolver_cn, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	state->sock = nn_socket(AF_SP, NN_SUB);
+	if (state->sock == -1) {
+		OC_DEBUG(0, "Unable to create the notification bus socket: %s", nn_strerror(errno));
+		return MAPISTORE_ERR_CONTEXT_FAILED;
+	}
+
+	if (nn_bind(state->sock, state->bind_addr) == -1) {
+		OC_DEBUG(0, "Unable to bind the notification bus on %s: %s", state->bind_addr, nn_strerror(errno));
+		nn_close(state->sock);
+		state->sock = -1;
+		return MAPISTORE_ERR_CONN_REFUSED;
+	}
+
+	OC_DEBUG(3, "Notification bus listening on %s for shard %s", state->bind_addr, bus_nanomsg_local_shard(bus));
+	return MAPISTORE_SUCCESS;
+}
+
+
+static enum mapistore_error bus_nanomsg_subscribe(struct mapistore_notification_bus *bus,
+						  struct mapistore_context *mstore_ctx,
+						  struct GUID uuid)
+{
+	struct bus_nanomsg			*state;
+	struct bus_nanomsg_subscription		*s;
+	enum mapistore_error			retval;
+	DATA_BLOB				topic;
+
+	state = bus_nanomsg_state(bus);
+	MAPISTORE_RETVAL_IF(!state, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (s = state->subscriptions; s; s = s->next) {
+		if (GUID_equal(&s->uuid, &uuid)) return MAPISTORE_SUCCESS;
+	}
+
+	retval = bus_nanomsg_listen(bus, state);
+	MAPISTORE_RETVAL_IF(retval, retval, NULL);
+
+	s = talloc_zero(state, struct bus_nanomsg_subscription);
+	MAPISTORE_RETVAL_IF(!s, MAPISTORE_ERR_NO_MEMORY, NULL);
+	s->uuid = uuid;
+
+	MAPISTORE_RETVAL_IF(!NT_STATUS_IS_OK(GUID_to_ndr_blob(&uuid, s, &topic)), MAPISTORE_ERR_NO_MEMORY, s);
+	if (nn_setsockopt(state->sock, NN_SUB, NN_SUB_SUBSCRIBE, topic.data, topic.length) == -1) {
+		OC_DEBUG(0, "Unable to subscribe to the notification bus: %s", nn_strerror(errno));
+		talloc_free(s);
+		return MAPISTORE_ERR_CONTEXT_FAILED;
+	}
+	data_blob_free(&topic);
+
+	DLIST_ADD(state->subscriptions, s);
+
+	/* The process registers its socket once, with its first session */
+	if (!state->registered) {
+		retval = mapistore_notification_resolver_add(mstore_ctx, state->resolver_cn, state->bind_addr);
+		if (retval != MAPISTORE_SUCCESS && retval != MAPISTORE_ERR_EXIST) {
+			OC_DEBUG(0, "Unable to register %s on the notification bus: %s",
+				 state->bind_addr, mapistore_errstr(retval));
+			return retval;
+		}
+		state->registered = true;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+static enum mapistore_error bus_nanomsg_unsubscribe(struct mapistore_notification_bus *bus,
+						    struct mapistore_context *mstore_ctx,
+						    struct GUID uuid)
+{
+	struct bus_nanomsg			*state;
+	struct bus_nanomsg_subscription		*s;
+	enum mapistore_error			retval;
+	DATA_BLOB				topic;
+
+	state = bus_nanomsg_state(bus);
+	MAPISTORE_RETVAL_IF(!state, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (s = state->subscriptions; s; s = s->next) {
+		if (GUID_equal(&s->uuid, &uuid)) break;
+	}
+	MAPISTORE_RETVAL_IF(!s, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	if (NT_STATUS_IS_OK(GUID_to_ndr_blob(&uuid, s, &topic))) {
+		nn_setsockopt(state->sock, NN_SUB, NN_SUB_UNSUBSCRIBE, topic.data, topic.length);
+	}
+	DLIST_REMOVE(state->subscriptions, s);
+	talloc_free(s);
+
+	/* No session left: publishers do not need to reach us anymore */
+	if (!state->subscriptions && state->registered) {
+		state->registered = false;
+		retval = mapistore_notification_resolver_delete(mstore_ctx, state->resolver_cn, state->bind_addr);
+		if (retval != MAPISTORE_SUCCESS && retval != MAPISTORE_ERR_NOT_FOUND) {
+			OC_DEBUG(1, "Unable to unregister %s from the notification bus: %s",
+				 state->bind_addr, mapistore_errstr(retval));
+		}
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Connect the PUB socket of a shard to its subscribers, as
+   listed in the resolver, when they were not looked up recently
+
+   \param bus pointer to the notification bus
+   \param mstore_ctx pointer to the mapistore context
+   \param state pointer to the state of the bus in this process
+   \param name the name of the shard
+
+   \return the shard on success, otherwise NULL
+ */
+static struct bus_nanomsg_shard *bus_nanomsg_shard_get(struct mapistore_notification_bus *bus,
+						       struct mapistore_context *mstore_ctx,
+						       struct bus_nanomsg *state,
+						       const char *name)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct bus_nanomsg_shard	*shard;
+	enum mapistore_error		retval;
+	const char			**hosts = NULL;
+	char				*cn;
+	char				**kept_hosts;
+	int				*kept_endpoints;
+	uint32_t			count = 0;
+	uint32_t			kept;
+	uint32_t			i, j;
+	time_t				now;
+
+	for (shard = state->shards; shard; shard = shard->next) {
+		if (!strcmp(shard->name, name)) break;
+	}
+
+	now = time(NULL);
+	if (shard && shard->loaded && now - shard->loaded < state->refresh) {
+		return shard;
+	}
+
+	if (!shard) {
+		shard = talloc_zero(state, struct bus_nanomsg_shard);
+		if (!shard) return NULL;
+		shard->name = talloc_strdup(shard, name);
+		shard->sock = nn_socket(AF_SP, NN_PUB);
+		if (!shard->name || shard->sock == -1) {
+			OC_DEBUG(0, "Unable to create the notification bus socket for shard %s", name);
+			talloc_free(shard);
+			return NULL;
+		}
+		talloc_set_destructor((void *)shard, (int (*)(void *))bus_nanomsg_shard_destructor);
+		DLIST_ADD(state->shards, shard);
+	}
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return shard;
+
+	cn = talloc_asprintf(mem_ctx, MSTORE_BUS_FMT_RESOLVER, name);
+	retval = mapistore_notification_resolver_get(mem_ctx, mstore_ctx, cn, &count, &hosts);
+	if (retval != MAPISTORE_SUCCESS && retval != MAPISTORE_ERR_NOT_FOUND) {
+		/* Keep the subscribers we know of */
+		OC_DEBUG(1, "Unable to look the subscribers of shard %s up: %s", name, mapistore_errstr(retval));
+		talloc_free(mem_ctx);
+		return shard;
+	}
+	if (retval == MAPISTORE_ERR_NOT_FOUND) {
+		count = 0;
+	}
+
+	kept_hosts = talloc_array(shard, char *, count);
+	kept_endpoints = talloc_array(shard, int, count);
+	if (count && (!kept_hosts || !kept_endpoints)) {
+		talloc_free(kept_hosts);
+		talloc_free(kept_endpoints);
+		talloc_free(mem_ctx);
+		return shard;
+	}
+
+	/* Keep the connections still listed, open the new ones */
+	kept = 0;
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < shard->count; j++) {
+			if (shard->hosts[j] && !strcmp(shard->hosts[j], hosts[i])) break;
+		}
+		if (j < shard->count) {
+			kept_hosts[kept] = talloc_steal(kept_hosts, shard->hosts[j]);
+			kept_endpoints[kept] = shard->endpoints[j];
+			shard->hosts[j] = NULL;
+		} else {
+			kept_endpoints[kept] = nn_connect(shard->sock, hosts[i]);
+			if (kept_endpoints[kept] < 0) {
+				OC_DEBUG(0, "Unable to connect to %s: %s", hosts[i], nn_strerror(errno));
+				continue;
+			}
+			kept_hosts[kept] = talloc_strdup(kept_hosts, hosts[i]);
+		}
+		kept++;
+	}
+
+	/* and close the connections to the subscribers gone */
+	for (j = 0; j < shard->count; j++) {
+		if (shard->hosts[j]) {
+			nn_shutdown(shard->sock, shard->endpoints[j]);
+		}
+	}
+
+	talloc_free(shard->hosts);
+	talloc_free(shard->endpoints);
+	shard->hosts = kept_hosts;
+	shard->endpoints = kept_endpoints;
+	shard->count = kept;
+	shard->loaded = now;
+
+	talloc_free(mem_ctx);
+	return shard;
+}
+
+
+static enum mapistore_error bus_nanomsg_publish(struct mapistore_notification_bus *bus,
+						struct mapistore_context *mstore_ctx,
+						struct GUID uuid, const uint8_t *payload,
+						size_t length)
+{
+	struct bus_nanomsg		*state;
+	struct bus_nanomsg_shard	*shard;
+	DATA_BLOB			topic;
+	uint8_t				*msg;
+	int				bytes;
+
+	state = bus_nanomsg_state(bus);
+	MAPISTORE_RETVAL_IF(!state, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	shard = bus_nanomsg_shard_get(bus, mstore_ctx, state, bus_nanomsg_owner_shard(bus, mstore_ctx));
+	MAPISTORE_RETVAL_IF(!shard, MAPISTORE_ERR_CONTEXT_FAILED, NULL);
+	MAPISTORE_RETVAL_IF(!shard->count, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	MAPISTORE_RETVAL_IF(!NT_STATUS_IS_OK(GUID_to_ndr_blob(&uuid, NULL, &topic)), MAPISTORE_ERR_NO_MEMORY, NULL);
+	msg = nn_allocmsg(BUS_NANOMSG_TOPIC_LEN + length, 0);
+	if (!msg) {
+		data_blob_free(&topic);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	memcpy(msg, topic.data, BUS_NANOMSG_TOPIC_LEN);
+	memcpy(msg + BUS_NANOMSG_TOPIC_LEN, payload, length);
+	data_blob_free(&topic);
+
+	/* The socket owns the message once sent */
+	bytes = nn_send(shard->sock, &msg, NN_MSG, NN_DONTWAIT);
+	if (bytes < 0) {
+		OC_DEBUG(0, "Unable to publish on shard %s: %s", shard->name, nn_strerror(errno));
+		nn_freemsg(msg);
+		return MAPISTORE_ERR_CONN_REFUSED;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Queue the messages waiting on the SUB socket to the
+   sessions they are addressed to
+
+   \param state pointer to the state of the bus in this process
+ */
+static void bus_nanomsg_drain(struct bus_nanomsg *state)
+{
+	struct bus_nanomsg_subscription	*s;
+	struct GUID			uuid;
+	DATA_BLOB			topic;
+	uint8_t				*msg = NULL;
+	uint8_t				*data;
+	int				bytes;
+
+	while ((bytes = nn_recv(state->sock, &msg, NN_MSG, NN_DONTWAIT)) >= 0) {
+		if (bytes <= BUS_NANOMSG_TOPIC_LEN) {
+			nn_freemsg(msg);
+			continue;
+		}
+
+		topic = data_blob_const(msg, BUS_NANOMSG_TOPIC_LEN);
+		if (!NT_STATUS_IS_OK(GUID_from_ndr_blob(&topic, &uuid))) {
+			nn_freemsg(msg);
+			continue;
+		}
+
+		for (s = state->subscriptions; s; s = s->next) {
+			if (GUID_equal(&s->uuid, &uuid)) break;
+		}
+		if (s) {
+			data = talloc_realloc(s, s->pending.data, uint8_t,
+					      s->pending.length + bytes - BUS_NANOMSG_TOPIC_LEN);
+			if (data) {
+				memcpy(data + s->pending.length, msg + BUS_NANOMSG_TOPIC_LEN,
+				       bytes - BUS_NANOMSG_TOPIC_LEN);
+				s->pending.data = data;
+				s->pending.length += bytes - BUS_NANOMSG_TOPIC_LEN;
+			} else {
+				OC_DEBUG(0, "No memory to queue %d bytes of notifications", bytes);
+			}
+		}
+		nn_freemsg(msg);
+	}
+}
+
+
+static enum mapistore_error bus_nanomsg_fetch(TALLOC_CTX *mem_ctx,
+					      struct mapistore_notification_bus *bus,
+					      struct mapistore_context *mstore_ctx,
+					      struct GUID uuid, uint8_t **payload,
+					      size_t *length)
+{
+	struct bus_nanomsg			*state;
+	struct bus_nanomsg_subscription		*s;
+
+	state = bus_nanomsg_state(bus);
+	MAPISTORE_RETVAL_IF(!state, MAPISTORE_ERR_NO_MEMORY, NULL);
+	MAPISTORE_RETVAL_IF(state->sock == -1, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	bus_nanomsg_drain(state);
+
+	for (s = state->subscriptions; s; s = s->next) {
+		if (GUID_equal(&s->uuid, &uuid)) break;
+	}
+	MAPISTORE_RETVAL_IF(!s || !s->pending.length, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	*payload = talloc_steal(mem_ctx, s->pending.data);
+	*length = s->pending.length;
+	s->pending = data_blob_null;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+static enum mapistore_error bus_nanomsg_refresh(struct mapistore_notification_bus *bus,
+						struct mapistore_context *mstore_ctx)
+{
+	struct bus_nanomsg		*state;
+	struct bus_nanomsg_shard	*shard;
+
+	state = bus_nanomsg_state(bus);
+	MAPISTORE_RETVAL_IF(!state, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	for (shard = state->shards; shard; shard = shard->next) {
+		shard->loaded = 0;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+static const struct mapistore_notification_bus_ops bus_nanomsg_ops = {
+	.name		= "nanomsg",
+	.init		= bus_nanomsg_init,
+	.subscribe	= bus_nanomsg_subscribe,
+	.unsubscribe	= bus_nanomsg_unsubscribe,
+	.publish	= bus_nanomsg_publish,
+	.fetch		= bus_nanomsg_fetch,
+	.refresh	= bus_nanomsg_refresh,
+};
+
+
+static const struct mapistore_notification_bus_ops *bus_backends[] = {
+	&bus_memcached_ops,
+	&bus_nanomsg_ops,
+	NULL
+};
+
+
+/**
+   \details Initialize the notification bus selected with
+   mapistore:notification_bus
+
+   \param mem_ctx pointer to the memory context
+   \param lp_ctx loadparm_context to get smb.conf options
+   \param busp pointer on pointer to the bus to return
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_notification_bus_init(TALLOC_CTX *mem_ctx,
+						     struct loadparm_context *lp_ctx,
+						     struct mapistore_notification_bus **busp)
+{
+	struct mapistore_notification_bus	*bus;
+	enum mapistore_error			retval;
+	const char				*name;
+	int					i;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!lp_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!busp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	name = lpcfg_parm_string(lp_ctx, NULL, "mapistore", "notification_bus");
+	if (!name) {
+		name = MSTORE_BUS_DFLT;
+	}
+
+	for (i = 0; bus_backends[i]; i++) {
+		if (!strcasecmp(bus_backends[i]->name, name)) break;
+	}
+	if (!bus_backends[i]) {
+		OC_DEBUG(0, "Unknown notification bus '%s'", name);
+		return MAPISTORE_ERR_INVALID_PARAMETER;
+	}
+
+	bus = talloc_zero(mem_ctx, struct mapistore_notification_bus);
+	MAPISTORE_RETVAL_IF(!bus, MAPISTORE_ERR_NO_MEMORY, NULL);
+	bus->ops = bus_backends[i];
+	bus->lp_ctx = lp_ctx;
+
+	if (bus->ops->init) {
+		retval = bus->ops->init(bus, lp_ctx);
+		MAPISTORE_RETVAL_IF(retval, retval, bus);
+	}
+
+	OC_DEBUG(5, "Notifications delivered over the %s bus", bus->ops->name);
+	*busp = bus;
+	return MAPISTORE_SUCCESS;
+}
+
+
+static struct mapistore_notification_bus *mapistore_notification_bus_get(struct mapistore_context *mstore_ctx)
+{
+	if (!mstore_ctx || !mstore_ctx->notification_ctx) return NULL;
+
+	return mstore_ctx->notification_ctx->bus;
+}
+
+
+/**
+   \details Start receiving the deliveries of an emsmdb session in
+   this process
+
+   \param mstore_ctx pointer to the mapistore context
+   \param uuid the session UUID
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_bus_subscribe(struct mapistore_context *mstore_ctx,
+								   struct GUID uuid)
+{
+	struct mapistore_notification_bus	*bus;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	bus = mapistore_notification_bus_get(mstore_ctx);
+	MAPISTORE_RETVAL_IF(!bus, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	if (!bus->ops->subscribe) return MAPISTORE_SUCCESS;
+
+	return bus->ops->subscribe(bus, mstore_ctx, uuid);
+}
+
+
+/**
+   \details Stop receiving the deliveries of an emsmdb session and
+   drop the ones not fetched yet
+
+   \param mstore_ctx pointer to the mapistore context
+   \param uuid the session UUID
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_bus_unsubscribe(struct mapistore_context *mstore_ctx,
+								     struct GUID uuid)
+{
+	struct mapistore_notification_bus	*bus;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	bus = mapistore_notification_bus_get(mstore_ctx);
+	MAPISTORE_RETVAL_IF(!bus, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	if (!bus->ops->unsubscribe) return MAPISTORE_SUCCESS;
+
+	return bus->ops->unsubscribe(bus, mstore_ctx, uuid);
+}
+
+
+/**
+   \details Deliver a payload to an emsmdb session
+
+   \param mstore_ctx pointer to the mapistore context, opened for the
+   owner of the mailbox of the session
+   \param uuid the session UUID
+   \param payload the payload data
+   \param length the length of the payload data
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_bus_publish(struct mapistore_context *mstore_ctx,
+								 struct GUID uuid, const uint8_t *payload,
+								 size_t length)
+{
+	struct mapistore_notification_bus	*bus;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!payload, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!length, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	bus = mapistore_notification_bus_get(mstore_ctx);
+	MAPISTORE_RETVAL_IF(!bus, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	return bus->ops->publish(bus, mstore_ctx, uuid, payload, length);
+}
+
+
+/**
+   \details Retrieve and consume the payloads delivered to an emsmdb
+   session
+
+   \param mem_ctx the memory context to use for data allocation
+   \param mstore_ctx pointer to the mapistore context
+   \param uuid the session UUID
+   \param payload pointer on pointer to the data to return
+   \param length pointer on the length of the payload data to return
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND when
+   nothing was delivered, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_bus_fetch(TALLOC_CTX *mem_ctx,
+							       struct mapistore_context *mstore_ctx,
+							       struct GUID uuid, uint8_t **payload,
+							       size_t *length)
+{
+	struct mapistore_notification_bus	*bus;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!payload, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!length, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	bus = mapistore_notification_bus_get(mstore_ctx);
+	MAPISTORE_RETVAL_IF(!bus, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	return bus->ops->fetch(mem_ctx, bus, mstore_ctx, uuid, payload, length);
+}
+
+
+/**
+   \details Tell the bus that sessions may have subscribed since the
+   subscribers were last looked up
+
+   \param mstore_ctx pointer to the mapistore context
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_notification_bus_refresh(struct mapistore_context *mstore_ctx)
+{
+	struct mapistore_notification_bus	*bus;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	bus = mapistore_notification_bus_get(mstore_ctx);
+	MAPISTORE_RETVAL_IF(!bus, MAPISTORE_ERR_NOT_AVAILABLE, NULL);
+
+	if (!bus->ops->refresh) return MAPISTORE_SUCCESS;
+
+	return bus->ops->refresh(bus, mstore_ctx);
+}
@@ -25,6 +25,7 @@
 #include <talloc.h>
 #include "backends/namedprops_backend.h"
 #include "utils/dlinklist.h"
+#include "mapiproxy/util/ccan/htable/htable.h"
 #include "mapiproxy/libmapistore/gen_ndr/mapistore_notification.h"
 
 #ifndef	ISDOT
@@ -68,23 +69,25 @@ struct id_mapping_context {
 
 
 /**
-   Free context identifier list
+   Context identifiers and open contexts
 
-   This structure is a double chained list storing unused context
-   identifiers.
+   Released context identifiers are kept in the free_ids stack and
+   reused first. The open contexts are indexed by identifier in the
+   contexts array and by URI in uri_ht, so every mapistore call
+   resolves its context without walking the context list. The indexing
+   contexts of the session are indexed by owner in indexing_ht.
  */
-struct context_id_list {
-	uint32_t		context_id;
-	struct context_id_list	*prev;
-	struct context_id_list	*next;
-};
-
-
 struct processing_context {
 	struct id_mapping_context	*mapping_ctx;
-	struct context_id_list		*free_ctx;
+	uint32_t			*free_ids;
+	uint32_t			free_count;
 	uint32_t			last_context_id;
 	uint64_t			dflt_start_id;
+	struct backend_context_list	**contexts;	/* indexed by context identifier */
+	uint8_t				*released;	/* identifiers in free_ids */
+	uint32_t			contexts_size;
+	struct htable			uri_ht;		/* struct backend_context_list by URI */
+	struct htable			indexing_ht;	/* struct indexing_context_list by owner */
 };
 
 struct indexing_context_list {
@@ -93,14 +96,32 @@ struct indexing_context_list {
 	struct indexing_context_list	*next;
 };
 
+/**
+   In-memory replica GUID to replica ID pair
+ */
+struct replica_mapping_entry {
+	uint16_t			replid;
+	struct GUID			guid;
+};
+
 struct replica_mapping_context_list {
 	struct tdb_context		*tdb;
+	void				*conn;		/* MYSQL * when mappings live in MySQL */
 	char				*username;
 	uint32_t			ref_count;
+	struct replica_mapping_entry	*entries;
+	uint32_t			entries_count;
 	struct replica_mapping_context_list	*prev;
 	struct replica_mapping_context_list	*next;
 };
 #define	MAPISTORE_DB_REPLICA_MAPPING	"replica_mapping.tdb"
+#define	MAPISTORE_REPLICA_MAPPING_TABLE	"mapistore_replica_mapping"
+
+#define	MAPISTORE_DB_FREEBUSY		"freebusy.tdb"
+#define	MAPISTORE_DB_CONTENT_INDEX	"content_index.tdb"
+#define	MAPISTORE_DB_TOMBSTONES		"tombstones.tdb"
+#define	MAPISTORE_DB_ATTACHMENTS	"attachments.tdb"
+#define	MAPISTORE_DB_CONVERSATIONS	"conversations.tdb"
 
 /**
    The database name where in use ID mappings are stored
@@ -125,15 +146,34 @@ __BEGIN_DECLS
 #define PR_MODIFIER_FLAGS			0x405a0003
 #define	PR_RECIPIENT_ON_NORMAL_MSG_COUNT	0x66af0003
 
+/* definitions from mapistore_freebusy.c */
+enum mapistore_error mapistore_freebusy_summary_load(TALLOC_CTX *, const char *, uint64_t, uint32_t, uint32_t, struct mapistore_freebusy_event **, uint32_t *);
+enum mapistore_error mapistore_freebusy_summary_store(const char *, uint64_t, uint32_t, uint32_t, const struct mapistore_freebusy_event *, uint32_t);
+
+/* definitions from mapistore_context_pool.c */
+bool mapistore_context_pool_enabled(void);
+void mapistore_context_pool_bind_conn_info(struct mapistore_connection_info *, const struct mapistore_connection_info *);
+enum mapistore_error mapistore_context_pool_park(struct mapistore_context *, struct backend_context *);
+enum mapistore_error mapistore_context_pool_take(struct mapistore_context *, struct indexing_context *, const char *, struct backend_context **);
+struct indexing_context *mapistore_context_pool_get_indexing(const char *);
+
+/* definitions from mapistore_profile.c */
+void mapistore_backend_profile_start(struct timespec *);
+enum mapistore_error mapistore_backend_profile_end(const struct mapistore_backend *, enum mapistore_backend_op, const char *, const struct timespec *, enum mapistore_error);
+void mapistore_shared_stats_indexing(uint64_t, uint64_t);
+
 /* definitions from mapistore_processing.c */
 const char *mapistore_get_mapping_path(void);
 enum mapistore_error mapistore_init_mapping_context(struct processing_context *);
 enum mapistore_error mapistore_get_context_id(struct processing_context *, uint32_t *);
 enum mapistore_error mapistore_free_context_id(struct processing_context *, uint32_t);
+enum mapistore_error mapistore_register_context(struct processing_context *, struct backend_context_list *);
+void mapistore_unregister_context(struct processing_context *, struct backend_context_list *);
+enum mapistore_error mapistore_register_indexing(struct processing_context *, struct indexing_context_list *);
 
 
 /* definitions from mapistore_backend.c */
-enum mapistore_error mapistore_backend_init(TALLOC_CTX *, const char *);
+enum mapistore_error mapistore_backend_init(TALLOC_CTX *, const char *, bool, bool);
 enum mapistore_error mapistore_backend_registered(const char *);
 enum mapistore_error mapistore_backend_list_contexts(const char *, struct indexing_context *, TALLOC_CTX *, struct mapistore_contexts_list **);
 enum mapistore_error mapistore_backend_create_context(TALLOC_CTX *, struct mapistore_connection_info *, struct indexing_context *, const char *, const char *, uint64_t, struct backend_context **);
@@ -152,11 +192,14 @@ enum mapistore_error mapistore_backend_folder_move_copy_messages(struct backend_
 enum mapistore_error mapistore_backend_folder_move_folder(struct backend_context *, void *, void *, TALLOC_CTX *, const char *);
 enum mapistore_error mapistore_backend_folder_copy_folder(struct backend_context *, void *, void *, TALLOC_CTX *, bool, const char *);
 enum mapistore_error mapistore_backend_folder_get_deleted_fmids(struct backend_context *, void *, TALLOC_CTX *, enum mapistore_table_type, uint64_t, struct UI8Array_r **, uint64_t *);
+enum mapistore_error mapistore_backend_folder_get_changed_fmids(struct backend_context *, void *, TALLOC_CTX *, enum mapistore_table_type, uint64_t, struct UI8Array_r **);
 enum mapistore_error mapistore_backend_folder_get_child_count(struct backend_context *, void *, enum mapistore_table_type, uint32_t *);
 enum mapistore_error mapistore_backend_folder_get_child_fid_by_name(struct backend_context *, void *, const char *, uint64_t *);
 enum mapistore_error mapistore_backend_folder_open_table(struct backend_context *, void *, TALLOC_CTX *, enum mapistore_table_type, uint32_t, void **, uint32_t *);
 enum mapistore_error mapistore_backend_folder_modify_permissions(struct backend_context *, void *, uint8_t, uint16_t, struct PermissionData *);
 enum mapistore_error mapistore_backend_folder_preload_message_bodies(struct backend_context *, void *, enum mapistore_table_type, const struct UI8Array_r *);
+enum mapistore_error mapistore_backend_folder_set_read_flags(struct backend_context *, void *, uint32_t, const uint64_t *, uint8_t);
+enum mapistore_error mapistore_backend_folder_delete_messages(struct backend_context *, void *, uint32_t, const uint64_t *, uint8_t);
 
 enum mapistore_error mapistore_backend_message_get_message_data(struct backend_context *, void *, TALLOC_CTX *, struct mapistore_message **);
 enum mapistore_error mapistore_backend_message_modify_recipients(struct backend_context *, void *, struct SPropTagArray *, uint16_t, struct mapistore_message_recipient *);
@@ -174,12 +217,18 @@ enum mapistore_error mapistore_backend_table_set_columns(struct backend_context
 enum mapistore_error mapistore_backend_table_set_restrictions(struct backend_context *, void *, struct mapi_SRestriction *, uint8_t *);
 enum mapistore_error mapistore_backend_table_set_sort_order(struct backend_context *, void *, struct SSortOrderSet *, uint8_t *);
 enum mapistore_error mapistore_backend_table_get_row(struct backend_context *, void *, TALLOC_CTX *, enum mapistore_query_type, uint32_t, struct mapistore_property_data **);
+enum mapistore_error mapistore_backend_table_get_rows(struct backend_context *, void *, TALLOC_CTX *, enum mapistore_query_type, uint32_t, uint32_t, struct mapistore_property_data ***, uint32_t *);
 enum mapistore_error mapistore_backend_table_get_row_count(struct backend_context *, void *, enum mapistore_query_type, uint32_t *);
 enum mapistore_error mapistore_backend_table_handle_destructor(struct backend_context *, void *, uint32_t);
 
 enum mapistore_error mapistore_backend_properties_get_available_properties(struct backend_context *, void *, TALLOC_CTX *, struct SPropTagArray **);
 enum mapistore_error mapistore_backend_properties_get_properties(struct backend_context *, void *, TALLOC_CTX *, uint16_t, enum MAPITAGS *, struct mapistore_property_data *);
 enum mapistore_error mapistore_backend_properties_set_properties(struct backend_context *, void *, struct SRow *);
+enum mapistore_error mapistore_backend_properties_open_property_stream(struct backend_context *, void *, TALLOC_CTX *, enum MAPITAGS, enum mapistore_stream_mode, void **, uint64_t *);
+enum mapistore_error mapistore_backend_properties_copy_object(struct backend_context *, void *, void *, struct SPropTagArray *, bool);
+enum mapistore_error mapistore_backend_stream_read(struct backend_context *, void *, TALLOC_CTX *, uint64_t, uint32_t, DATA_BLOB *);
+enum mapistore_error mapistore_backend_stream_write(struct backend_context *, void *, uint64_t, DATA_BLOB);
+enum mapistore_error mapistore_backend_stream_commit(struct backend_context *, void *, uint64_t);
 
 enum mapistore_error mapistore_backend_manager_generate_uri(struct backend_context *, TALLOC_CTX *, const char *, const char *, const char *, const char *, char **);
 
@@ -196,6 +245,7 @@ enum mapistore_error mapistore_indexing_record_del_fmid(struct mapistore_context
 /* definitions from mapistore_notification.c */
 enum mapistore_error mapistore_notification_init(TALLOC_CTX *, struct loadparm_context *, struct mapistore_notification_context **);
 enum mapistore_error mapistore_notification_subscription_get(TALLOC_CTX *, struct mapistore_context *, struct GUID, struct mapistore_notification_subscription *);
+enum mapistore_error mapistore_notification_subscription_find(TALLOC_CTX *, struct mapistore_context *, struct GUID, uint16_t, uint64_t, struct mapistore_notification_subscription *);
 
 __END_DECLS
 
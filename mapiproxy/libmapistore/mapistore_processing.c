@@ -30,6 +30,7 @@
 #include "mapistore_private.h"
 #include "utils/dlinklist.h"
 #include "libmapi/libmapi_private.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
 
 #include <tdb.h>
 
@@ -181,32 +182,60 @@ enum mapistore_error mapistore_init_mapping_context(struct processing_context *p
  */
 enum mapistore_error mapistore_get_context_id(struct processing_context *pctx, uint32_t *context_id)
 {
-	struct context_id_list	*el;
-
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!pctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
 
-	/* Step 1. The free context list doesn't exist yet */
-	if (!pctx->free_ctx) {
+	/* Released identifiers are reused first */
+	if (pctx->free_count) {
+		*context_id = pctx->free_ids[--pctx->free_count];
+		pctx->released[*context_id] = 0;
+	} else {
 		pctx->last_context_id++;
 		*context_id = pctx->last_context_id;
 	}
 
-	/* Step 2. We have a free list */
-	for (el = pctx->free_ctx; el; el = el->next) {
-		if (el->context_id) {
-			*context_id = el->context_id;
-			DLIST_REMOVE(pctx->free_ctx, el);
-			break;
-		}
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Grow the context identifier arrays so they can hold a given
+   identifier
+ */
+static enum mapistore_error mapistore_context_id_reserve(struct processing_context *pctx, uint32_t context_id)
+{
+	struct backend_context_list	**contexts;
+	uint8_t				*released;
+	uint32_t			*free_ids;
+	uint32_t			size;
+
+	if (context_id < pctx->contexts_size) return MAPISTORE_SUCCESS;
+
+	size = pctx->contexts_size ? pctx->contexts_size : 16;
+	while (size <= context_id) {
+		size *= 2;
 	}
 
+	contexts = talloc_realloc(pctx, pctx->contexts, struct backend_context_list *, size);
+	MAPISTORE_RETVAL_IF(!contexts, MAPISTORE_ERR_NO_MEMORY, NULL);
+	pctx->contexts = contexts;
+	released = talloc_realloc(pctx, pctx->released, uint8_t, size);
+	MAPISTORE_RETVAL_IF(!released, MAPISTORE_ERR_NO_MEMORY, NULL);
+	pctx->released = released;
+	free_ids = talloc_realloc(pctx, pctx->free_ids, uint32_t, size);
+	MAPISTORE_RETVAL_IF(!free_ids, MAPISTORE_ERR_NO_MEMORY, NULL);
+	pctx->free_ids = free_ids;
+
+	memset(contexts + pctx->contexts_size, 0, (size - pctx->contexts_size) * sizeof (struct backend_context_list *));
+	memset(released + pctx->contexts_size, 0, size - pctx->contexts_size);
+	pctx->contexts_size = size;
+
 	return MAPISTORE_SUCCESS;
 }
 
 
 /**
-   \details Add a context identifier to the list
+   \details Add a context identifier to the free identifiers
 
    \param pctx pointer to the processing context
    \param context_id the identifier referencing the context to free
@@ -215,22 +244,116 @@ enum mapistore_error mapistore_get_context_id(struct processing_context *pctx, u
  */
 enum mapistore_error mapistore_free_context_id(struct processing_context *pctx, uint32_t context_id)
 {
-	struct context_id_list	*el;
+	enum mapistore_error	retval;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!pctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!context_id || context_id > pctx->last_context_id, MAPISTORE_ERR_CORRUPTED, NULL);
 
-	/* Step 1. Ensure the list is not corrupted */
-	for (el = pctx->free_ctx; el; el = el->next) {
-		if (el->context_id == context_id) {
-			return MAPISTORE_ERR_CORRUPTED;
-		}
+	retval = mapistore_context_id_reserve(pctx, context_id);
+	MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, NULL);
+
+	/* Ensure the identifier is not released twice */
+	MAPISTORE_RETVAL_IF(pctx->released[context_id], MAPISTORE_ERR_CORRUPTED, NULL);
+
+	pctx->released[context_id] = 1;
+	pctx->free_ids[pctx->free_count++] = context_id;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+static size_t mapistore_context_uri_rehash(const void *e, void *unused)
+{
+	return hash_string(((const struct backend_context_list *)e)->ctx->uri);
+}
+
+static size_t mapistore_indexing_owner_rehash(const void *e, void *unused)
+{
+	return hash_string(((const struct indexing_context_list *)e)->ctx->url);
+}
+
+static int mapistore_processing_context_destructor(struct processing_context *pctx)
+{
+	htable_clear(&pctx->uri_ht);
+	htable_clear(&pctx->indexing_ht);
+	return 0;
+}
+
+static void mapistore_processing_htables_init(struct processing_context *pctx)
+{
+	if (pctx->uri_ht.rehash) return;
+
+	htable_init(&pctx->uri_ht, mapistore_context_uri_rehash, NULL);
+	htable_init(&pctx->indexing_ht, mapistore_indexing_owner_rehash, NULL);
+	talloc_set_destructor(pctx, mapistore_processing_context_destructor);
+}
+
+
+/**
+   \details Index an open context by identifier and URI
+
+   \param pctx pointer to the processing context
+   \param el pointer to the context list element of the context
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_register_context(struct processing_context *pctx, struct backend_context_list *el)
+{
+	enum mapistore_error	retval;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!pctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!el || !el->ctx || !el->ctx->context_id, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	retval = mapistore_context_id_reserve(pctx, el->ctx->context_id);
+	MAPISTORE_RETVAL_IF(retval != MAPISTORE_SUCCESS, retval, NULL);
+
+	mapistore_processing_htables_init(pctx);
+	if (el->ctx->uri) {
+		MAPISTORE_RETVAL_IF(!htable_add(&pctx->uri_ht, hash_string(el->ctx->uri), el), MAPISTORE_ERR_NO_MEMORY, NULL);
+	}
+	pctx->contexts[el->ctx->context_id] = el;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Remove a context from the identifier and URI indexes
+
+   \param pctx pointer to the processing context
+   \param el pointer to the context list element of the context
+ */
+void mapistore_unregister_context(struct processing_context *pctx, struct backend_context_list *el)
+{
+	if (!pctx || !el || !el->ctx) return;
+
+	if (el->ctx->context_id < pctx->contexts_size && pctx->contexts[el->ctx->context_id] == el) {
+		pctx->contexts[el->ctx->context_id] = NULL;
 	}
+	if (el->ctx->uri && pctx->uri_ht.rehash) {
+		htable_del(&pctx->uri_ht, hash_string(el->ctx->uri), el);
+	}
+}
+
+
+/**
+   \details Index an indexing context of the session by owner
+
+   \param pctx pointer to the processing context
+   \param el pointer to the indexing context list element
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+enum mapistore_error mapistore_register_indexing(struct processing_context *pctx, struct indexing_context_list *el)
+{
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!pctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
+	MAPISTORE_RETVAL_IF(!el || !el->ctx || !el->ctx->url, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
 
-	/* Step 2. Create the element and add it to the list */
-	el = talloc_zero((TALLOC_CTX *)pctx, struct context_id_list);
-	el->context_id = context_id;
-	DLIST_ADD_END(pctx->free_ctx, el, struct context_id_list *);
+	mapistore_processing_htables_init(pctx);
+	MAPISTORE_RETVAL_IF(!htable_add(&pctx->indexing_ht, hash_string(el->ctx->url), el), MAPISTORE_ERR_NO_MEMORY, NULL);
 
 	return MAPISTORE_SUCCESS;
 }
@@ -0,0 +1,390 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_profile.c
+
+   \brief Backend call profiler
+
+   Every call mapistore makes into a backend goes through the wrappers
+   of mapistore_backend.c. When profiling is enabled, these wrappers
+   account each call in per-backend and per-operation counters: calls,
+   failures, total and maximum latency and a histogram of latencies
+   with power of two buckets. Independently, calls lasting longer than
+   the slow call threshold are logged with the backend, the operation
+   and the URI of the context they were made on.
+
+   When the process provides a shared area with
+   mapistore_set_shared_stats, the same counters and the hits and
+   misses of the indexing caches are also accounted there, with atomic
+   increments, so that other processes can read them while they are
+   updated.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+
+struct mapistore_backend_profile {
+	const char				*name;
+	struct mapistore_backend_op_stats	ops[MAPISTORE_BACKEND_OP_MAX];
+};
+
+static bool					profiling_enabled = false;
+static uint64_t					slow_call_usec = 0;
+static struct mapistore_backend_profile		*profiles = NULL;
+static uint32_t					profiles_count = 0;
+static struct mapistore_shared_stats		*shared_stats = NULL;
+
+static const char *backend_op_names[MAPISTORE_BACKEND_OP_MAX] = {
+	[MAPISTORE_BACKEND_OP_LIST_CONTEXTS] = "backend.list_contexts",
+	[MAPISTORE_BACKEND_OP_CREATE_CONTEXT] = "backend.create_context",
+	[MAPISTORE_BACKEND_OP_CREATE_ROOT_FOLDER] = "backend.create_root_folder",
+	[MAPISTORE_BACKEND_OP_GET_ROOT_FOLDER] = "context.get_root_folder",
+	[MAPISTORE_BACKEND_OP_GET_PATH] = "context.get_path",
+	[MAPISTORE_BACKEND_OP_FOLDER_OPEN_FOLDER] = "folder.open_folder",
+	[MAPISTORE_BACKEND_OP_FOLDER_CREATE_FOLDER] = "folder.create_folder",
+	[MAPISTORE_BACKEND_OP_FOLDER_DELETE] = "folder.delete",
+	[MAPISTORE_BACKEND_OP_FOLDER_OPEN_MESSAGE] = "folder.open_message",
+	[MAPISTORE_BACKEND_OP_FOLDER_CREATE_MESSAGE] = "folder.create_message",
+	[MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGE] = "folder.delete_message",
+	[MAPISTORE_BACKEND_OP_FOLDER_MOVE_COPY_MESSAGES] = "folder.move_copy_messages",
+	[MAPISTORE_BACKEND_OP_FOLDER_MOVE_FOLDER] = "folder.move_folder",
+	[MAPISTORE_BACKEND_OP_FOLDER_COPY_FOLDER] = "folder.copy_folder",
+	[MAPISTORE_BACKEND_OP_FOLDER_GET_DELETED_FMIDS] = "folder.get_deleted_fmids",
+	[MAPISTORE_BACKEND_OP_FOLDER_GET_CHANGED_FMIDS] = "folder.get_changed_fmids",
+	[MAPISTORE_BACKEND_OP_FOLDER_GET_CHILD_COUNT] = "folder.get_child_count",
+	[MAPISTORE_BACKEND_OP_FOLDER_OPEN_TABLE] = "folder.open_table",
+	[MAPISTORE_BACKEND_OP_FOLDER_MODIFY_PERMISSIONS] = "folder.modify_permissions",
+	[MAPISTORE_BACKEND_OP_FOLDER_PRELOAD_MESSAGE_BODIES] = "folder.preload_message_bodies",
+	[MAPISTORE_BACKEND_OP_FOLDER_SET_READ_FLAGS] = "folder.set_read_flags",
+	[MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGES] = "folder.delete_messages",
+	[MAPISTORE_BACKEND_OP_MESSAGE_GET_MESSAGE_DATA] = "message.get_message_data",
+	[MAPISTORE_BACKEND_OP_MESSAGE_MODIFY_RECIPIENTS] = "message.modify_recipients",
+	[MAPISTORE_BACKEND_OP_MESSAGE_SET_READ_FLAG] = "message.set_read_flag",
+	[MAPISTORE_BACKEND_OP_MESSAGE_SAVE] = "message.save",
+	[MAPISTORE_BACKEND_OP_MESSAGE_SUBMIT] = "message.submit",
+	[MAPISTORE_BACKEND_OP_MESSAGE_OPEN_ATTACHMENT] = "message.open_attachment",
+	[MAPISTORE_BACKEND_OP_MESSAGE_CREATE_ATTACHMENT] = "message.create_attachment",
+	[MAPISTORE_BACKEND_OP_MESSAGE_GET_ATTACHMENT_TABLE] = "message.get_attachment_table",
+	[MAPISTORE_BACKEND_OP_MESSAGE_OPEN_EMBEDDED_MESSAGE] = "message.open_embedded_message",
+	[MAPISTORE_BACKEND_OP_MESSAGE_CREATE_EMBEDDED_MESSAGE] = "message.create_embedded_message",
+	[MAPISTORE_BACKEND_OP_TABLE_GET_AVAILABLE_PROPERTIES] = "table.get_available_properties",
+	[MAPISTORE_BACKEND_OP_TABLE_SET_COLUMNS] = "table.set_columns",
+	[MAPISTORE_BACKEND_OP_TABLE_SET_RESTRICTIONS] = "table.set_restrictions",
+	[MAPISTORE_BACKEND_OP_TABLE_SET_SORT_ORDER] = "table.set_sort_order",
+	[MAPISTORE_BACKEND_OP_TABLE_GET_ROW] = "table.get_row",
+	[MAPISTORE_BACKEND_OP_TABLE_GET_ROWS] = "table.get_rows",
+	[MAPISTORE_BACKEND_OP_TABLE_GET_ROW_COUNT] = "table.get_row_count",
+	[MAPISTORE_BACKEND_OP_TABLE_HANDLE_DESTRUCTOR] = "table.handle_destructor",
+	[MAPISTORE_BACKEND_OP_PROPERTIES_GET_AVAILABLE_PROPERTIES] = "properties.get_available_properties",
+	[MAPISTORE_BACKEND_OP_PROPERTIES_GET_PROPERTIES] = "properties.get_properties",
+	[MAPISTORE_BACKEND_OP_PROPERTIES_SET_PROPERTIES] = "properties.set_properties",
+	[MAPISTORE_BACKEND_OP_PROPERTIES_OPEN_PROPERTY_STREAM] = "properties.open_property_stream",
+	[MAPISTORE_BACKEND_OP_PROPERTIES_COPY_OBJECT] = "properties.copy_object",
+	[MAPISTORE_BACKEND_OP_STREAM_READ] = "stream.read",
+	[MAPISTORE_BACKEND_OP_STREAM_WRITE] = "stream.write",
+	[MAPISTORE_BACKEND_OP_STREAM_COMMIT] = "stream.commit",
+	[MAPISTORE_BACKEND_OP_MANAGER_GENERATE_URI] = "manager.generate_uri",
+};
+
+
+/**
+   \details Configure the backend profiler
+
+   \param enabled whether backend calls are accounted
+   \param slow_call_msec the duration in milliseconds above which a
+   backend call is logged, 0 disables the slow call log
+ */
+_PUBLIC_ void mapistore_set_backend_profiling(bool enabled, uint32_t slow_call_msec)
+{
+	profiling_enabled = enabled;
+	slow_call_usec = (uint64_t) slow_call_msec * 1000;
+}
+
+
+/**
+   \details Return the name of a backend operation, as it appears in
+   the backend vtable
+
+   \param op the backend operation
+
+   \return the operation name
+ */
+_PUBLIC_ const char *mapistore_backend_op_name(enum mapistore_backend_op op)
+{
+	if (op >= MAPISTORE_BACKEND_OP_MAX) {
+		return "unknown";
+	}
+
+	return backend_op_names[op];
+}
+
+
+static struct mapistore_backend_profile *mapistore_backend_profile_lookup(const char *name, bool create)
+{
+	uint32_t	i;
+
+	for (i = 0; i < profiles_count; i++) {
+		if (!strcmp(profiles[i].name, name)) {
+			return &profiles[i];
+		}
+	}
+
+	if (!create) return NULL;
+
+	profiles = realloc_p(profiles, struct mapistore_backend_profile, profiles_count + 1);
+	if (!profiles) {
+		smb_panic("out of memory in mapistore_backend_profile_lookup");
+	}
+	memset(&profiles[profiles_count], 0, sizeof (struct mapistore_backend_profile));
+	profiles[profiles_count].name = smb_xstrdup(name);
+
+	return &profiles[profiles_count++];
+}
+
+
+/**
+   \details Account the counters of the process in a shared area
+
+   \param area pointer to the area, laid out as struct
+   mapistore_shared_stats and zeroed, NULL stops accounting there
+   \param size the size of the area
+
+   \return true on success, false if the area is too small
+ */
+_PUBLIC_ bool mapistore_set_shared_stats(void *area, size_t size)
+{
+	struct mapistore_shared_stats	*stats = (struct mapistore_shared_stats *) area;
+
+	if (!area) {
+		shared_stats = NULL;
+		return true;
+	}
+	if (size < sizeof (struct mapistore_shared_stats)) {
+		OC_DEBUG(0, "shared statistics area too small: %zu bytes, %zu needed",
+			 size, sizeof (struct mapistore_shared_stats));
+		return false;
+	}
+
+	stats->backends = MAPISTORE_SHARED_STATS_BACKENDS;
+	stats->ops = MAPISTORE_BACKEND_OP_MAX;
+	stats->buckets = MAPISTORE_BACKEND_PROFILE_BUCKETS;
+	shared_stats = stats;
+
+	return true;
+}
+
+
+static struct mapistore_shared_backend_stats *mapistore_shared_stats_backend(const char *name)
+{
+	struct mapistore_shared_backend_stats	*backend;
+	uint32_t				i;
+
+	for (i = 0; i < MAPISTORE_SHARED_STATS_BACKENDS; i++) {
+		backend = &shared_stats->backend[i];
+		if (!backend->name[0]) {
+			/* Only this process writes names, readers skip
+			 * the slot until the name is complete */
+			strncpy(backend->name, name, sizeof (backend->name) - 1);
+			return backend;
+		}
+		if (!strncmp(backend->name, name, sizeof (backend->name) - 1)) {
+			return backend;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void mapistore_shared_stats_account(struct mapistore_backend_op_stats *stats, bool failed,
+					   uint64_t usec, uint32_t bucket)
+{
+	uint64_t	max_usec;
+
+	__sync_fetch_and_add(&stats->count, 1);
+	if (failed) {
+		__sync_fetch_and_add(&stats->errors, 1);
+	}
+	__sync_fetch_and_add(&stats->total_usec, usec);
+	do {
+		max_usec = stats->max_usec;
+	} while (usec > max_usec && !__sync_bool_compare_and_swap(&stats->max_usec, max_usec, usec));
+	__sync_fetch_and_add(&stats->buckets[bucket], 1);
+}
+
+
+/**
+   \details Account indexing cache lookups in the shared area, if any
+
+   \param hits number of lookups served from the cache
+   \param misses number of lookups sent to the backend
+ */
+void mapistore_shared_stats_indexing(uint64_t hits, uint64_t misses)
+{
+	if (!shared_stats) return;
+
+	if (hits) {
+		__sync_fetch_and_add(&shared_stats->indexing_hits, hits);
+	}
+	if (misses) {
+		__sync_fetch_and_add(&shared_stats->indexing_misses, misses);
+	}
+}
+
+
+/**
+   \details Take the timestamp a backend call is measured from
+
+   \param start pointer to the timestamp to fill
+ */
+void mapistore_backend_profile_start(struct timespec *start)
+{
+	if (!profiling_enabled && !slow_call_usec && !shared_stats) return;
+
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+
+/**
+   \details Account a backend call
+
+   \param backend pointer to the backend called
+   \param op the backend operation
+   \param uri the URI of the context the call was made on, if any
+   \param start pointer to the timestamp taken with
+   mapistore_backend_profile_start before the call
+   \param ret the value returned by the backend
+
+   \return ret
+ */
+enum mapistore_error mapistore_backend_profile_end(const struct mapistore_backend *backend, enum mapistore_backend_op op,
+						   const char *uri, const struct timespec *start, enum mapistore_error ret)
+{
+	struct mapistore_backend_profile	*profile;
+	struct mapistore_backend_op_stats	*stats;
+	struct mapistore_shared_backend_stats	*shared;
+	struct timespec				end;
+	uint64_t				usec;
+	uint32_t				bucket;
+
+	if (!profiling_enabled && !slow_call_usec && !shared_stats) return ret;
+	if (!backend || op >= MAPISTORE_BACKEND_OP_MAX) return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usec = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000 +
+		(end.tv_nsec - start->tv_nsec) / 1000;
+
+	if (slow_call_usec && usec >= slow_call_usec) {
+		OC_DEBUG(1, "slow backend call: %s %s took %"PRIu64" ms (%s) on %s",
+			 backend->backend.name, backend_op_names[op], usec / 1000,
+			 mapistore_errstr(ret), uri ? uri : "no context");
+	}
+
+	for (bucket = 0; bucket < MAPISTORE_BACKEND_PROFILE_BUCKETS - 1 && (usec >> bucket); bucket++);
+
+	if (shared_stats) {
+		shared = mapistore_shared_stats_backend(backend->backend.name);
+		if (shared) {
+			mapistore_shared_stats_account(&shared->ops[op], ret != MAPISTORE_SUCCESS, usec, bucket);
+		}
+	}
+
+	if (!profiling_enabled) return ret;
+
+	profile = mapistore_backend_profile_lookup(backend->backend.name, true);
+	stats = &profile->ops[op];
+	stats->count++;
+	if (ret != MAPISTORE_SUCCESS) {
+		stats->errors++;
+	}
+	stats->total_usec += usec;
+	if (usec > stats->max_usec) {
+		stats->max_usec = usec;
+	}
+	stats->buckets[bucket]++;
+
+	return ret;
+}
+
+
+/**
+   \details Retrieve the counters of a backend operation
+
+   \param name the backend name
+   \param op the backend operation
+   \param stats pointer to the counters to fill
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if
+   the backend has not been called yet
+ */
+_PUBLIC_ enum mapistore_error mapistore_backend_profile_get(const char *name, enum mapistore_backend_op op,
+							    struct mapistore_backend_op_stats *stats)
+{
+	struct mapistore_backend_profile	*profile;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!name, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!stats, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(op >= MAPISTORE_BACKEND_OP_MAX, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	profile = mapistore_backend_profile_lookup(name, false);
+	MAPISTORE_RETVAL_IF(!profile, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	*stats = profile->ops[op];
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Log the counters of every backend operation called so far
+ */
+_PUBLIC_ void mapistore_backend_profile_dump(void)
+{
+	struct mapistore_backend_op_stats	*stats;
+	char					histogram[MAPISTORE_BACKEND_PROFILE_BUCKETS * 21 + 1];
+	size_t					len;
+	uint32_t				i, op, bucket;
+
+	if (!profiling_enabled) return;
+
+	for (i = 0; i < profiles_count; i++) {
+		for (op = 0; op < MAPISTORE_BACKEND_OP_MAX; op++) {
+			stats = &profiles[i].ops[op];
+			if (!stats->count) continue;
+
+			len = 0;
+			histogram[0] = '\0';
+			for (bucket = 0; bucket < MAPISTORE_BACKEND_PROFILE_BUCKETS; bucket++) {
+				len += snprintf(histogram + len, sizeof (histogram) - len, " %"PRIu64, stats->buckets[bucket]);
+			}
+
+			OC_DEBUG(3, "%s %s: %"PRIu64" calls, %"PRIu64" errors, avg %"PRIu64" us, max %"PRIu64" us, histogram:%s",
+				 profiles[i].name, backend_op_names[op], stats->count, stats->errors,
+				 stats->total_usec / stats->count, stats->max_usec, histogram);
+		}
+	}
+}
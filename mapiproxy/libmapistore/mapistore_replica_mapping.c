@@ -26,16 +26,44 @@
 #include "mapistore_private.h"
 #include "utils/dlinklist.h"
 #include "libmapi/libmapi_private.h"
+#include "../util/mysql.h"
+#include "../util/schema_migration.h"
 
 #include <tdb.h>
 
+/* Attempts to allocate a replica id before giving up on concurrent writers */
+#define	REPLICA_MAPPING_MYSQL_RETRIES	5
+
 static void mapistore_replica_mapping_set_next_replid(struct tdb_context *, uint16_t);
 static uint16_t mapistore_replica_mapping_get_next_replid(struct tdb_context *);
+static enum mapistore_error mapistore_replica_mapping_load(struct replica_mapping_context_list *);
+
+static char *default_replica_mapping_url = NULL;
 
 /* Special repl ids:
    - 0x01 is for server replica
    - 0x02 is for GetLocalReplicaIDs */
 
+/**
+   \details Set the default replica mapping backend url. If none is
+   set, mappings are stored in a per-user TDB file.
+
+   \param url mysql:// connection string or NULL
+ */
+_PUBLIC_ void mapistore_set_default_replica_mapping_url(const char *url)
+{
+	TALLOC_CTX *mem_ctx;
+
+	if (default_replica_mapping_url) talloc_free(default_replica_mapping_url);
+
+	if (url == NULL) {
+		default_replica_mapping_url = NULL;
+	} else {
+		mem_ctx = talloc_autofree_context();
+		default_replica_mapping_url = talloc_strdup(mem_ctx, url);
+	}
+}
+
 /**
    \details Search the replica_mapping record matching the username
 
@@ -62,29 +90,111 @@ static struct replica_mapping_context_list *mapistore_replica_mapping_search(str
 	return NULL;
 }
 
+static int context_list_destructor(struct replica_mapping_context_list *rmctx)
+{
+	if (rmctx->tdb) {
+		tdb_close(rmctx->tdb);
+	}
+	if (rmctx->conn) {
+		release_connection((MYSQL *)rmctx->conn);
+	}
+
+	return 0;
+}
+
 /**
-   \details Open connection to replica_mapping database for a given user
+   \details Open the per-user TDB replica_mapping database
 
-   \param mstore_ctx pointer to the mapistore context
-   \param username name for which the replica_mapping database has to be
-   created
+   \param rmctx pointer to the replica mapping context to fill
 
    \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
  */
+static enum mapistore_error mapistore_replica_mapping_open_tdb(struct replica_mapping_context_list *rmctx)
+{
+	TALLOC_CTX	*mem_ctx;
+	char		*dbpath = NULL;
+	char		*mapistore_dir = NULL;
 
-static int context_list_destructor(struct replica_mapping_context_list *rmctx)
+	mem_ctx = talloc_named(NULL, 0, "mapistore_replica_mapping_open_tdb");
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* ensure the user mapistore directory exists before any mapistore operation occurs */
+	mapistore_dir = talloc_asprintf(mem_ctx, "%s/%s",
+					mapistore_get_mapping_path(), rmctx->username);
+	MAPISTORE_RETVAL_IF(!mapistore_dir, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	mkdir(mapistore_dir, 0700);
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/%s/" MAPISTORE_DB_REPLICA_MAPPING,
+				 mapistore_get_mapping_path(), rmctx->username);
+	MAPISTORE_RETVAL_IF(!dbpath, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	rmctx->tdb = tdb_open(dbpath, 0, 0, O_RDWR|O_CREAT, 0600);
+	if (!rmctx->tdb) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_INIT;
+	}
+
+	/* Initialize database if it freshly created */
+	if (mapistore_replica_mapping_get_next_replid(rmctx->tdb) == 0xffff) {
+		mapistore_replica_mapping_set_next_replid(rmctx->tdb, 0x3);
+	}
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Connect to the MySQL database shared by all the nodes
+   storing replica mappings
+
+   \param rmctx pointer to the replica mapping context to fill
+   \param url mysql:// connection string
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_replica_mapping_open_mysql(struct replica_mapping_context_list *rmctx, const char *url)
 {
-	tdb_close(rmctx->tdb);
+	MYSQL	*conn = NULL;
+	int	ret;
+
+	create_connection(url, &conn);
+	MAPISTORE_RETVAL_IF(!conn, MAPISTORE_ERR_DATABASE_INIT, NULL);
+	rmctx->conn = conn;
+
+	if (!table_exists(conn, MAPISTORE_REPLICA_MAPPING_TABLE)) {
+		OC_DEBUG(3, "Creating schema for replica mapping on mysql %s", url);
+		ret = migrate_indexing_schema(url);
+		if (ret) {
+			OC_DEBUG(1, "Failed replica mapping schema creation using migration framework: %d", ret);
+			return MAPISTORE_ERR_DATABASE_INIT;
+		}
+	}
 
-	return 1;
+	return MAPISTORE_SUCCESS;
 }
 
+/**
+   \details Open connection to replica_mapping database for a given
+   user and load its mappings in memory
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username name for which the replica_mapping database has to be
+   created
+   \param rmctxp pointer on pointer to the returned replica mapping context
+
+   \note The mappings are stored in a per-user TDB unless the
+   mapistore:replica_mapping_backend parameter points to a MySQL
+   database, which is required when several nodes serve the same
+   mailboxes.
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
 _PUBLIC_ enum mapistore_error mapistore_replica_mapping_add(struct mapistore_context *mstore_ctx, const char *username, struct replica_mapping_context_list **rmctxp)
 {
-	TALLOC_CTX				*mem_ctx;
 	struct replica_mapping_context_list	*rmctx;
-	char					*dbpath = NULL;
-	char					*mapistore_dir = NULL;
+	enum mapistore_error			retval;
 
 	/* Sanity checks */
 	MAPISTORE_RETVAL_IF(!mstore_ctx, MAPISTORE_ERR_NOT_INITIALIZED, NULL);
@@ -95,41 +205,33 @@ _PUBLIC_ enum mapistore_error mapistore_replica_mapping_add(struct mapistore_con
 	*rmctxp = rmctx;
 	MAPISTORE_RETVAL_IF(rmctx, MAPISTORE_SUCCESS, NULL);
 
-	mem_ctx = talloc_named(NULL, 0, "mapistore_replica_mapping_init");
-
-	/* ensure the user mapistore directory exists before any mapistore operation occurs */
-	mapistore_dir = talloc_asprintf(mem_ctx, "%s/%s",
-					mapistore_get_mapping_path(), username);
-	MAPISTORE_RETVAL_IF(!mapistore_dir, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-
-	mkdir(mapistore_dir, 0700);
-
-	/* Step 1. Open/Create the replica_mapping database */
-	dbpath = talloc_asprintf(mem_ctx, "%s/%s/" MAPISTORE_DB_REPLICA_MAPPING, 
-				 mapistore_get_mapping_path(), username);
-	MAPISTORE_RETVAL_IF(!dbpath, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-	rmctx = talloc_zero(mstore_ctx->replica_mapping_list, struct replica_mapping_context_list);
-	MAPISTORE_RETVAL_IF(!rmctx, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
-	rmctx->tdb = tdb_open(dbpath, 0, 0, O_RDWR|O_CREAT, 0600);
-	if (!rmctx->tdb) {
-		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
-		talloc_free(rmctx);
-		talloc_free(mem_ctx);
-		return MAPISTORE_ERR_DATABASE_INIT;
-	}
+	/* Step 2. Open/Create the replica_mapping database */
+	rmctx = talloc_zero(mstore_ctx, struct replica_mapping_context_list);
+	MAPISTORE_RETVAL_IF(!rmctx, MAPISTORE_ERR_NO_MEMORY, NULL);
 	talloc_set_destructor(rmctx, context_list_destructor);
 	rmctx->username = talloc_strdup(rmctx, username);
+	MAPISTORE_RETVAL_IF(!rmctx->username, MAPISTORE_ERR_NO_MEMORY, rmctx);
 	rmctx->ref_count = 0;
-	DLIST_ADD_END(mstore_ctx->replica_mapping_list, rmctx, struct replica_mapping_context_list *);
 
-	*rmctxp = rmctx;
-
-	/* Step 2. Initialize database if it freshly created */
-	if (mapistore_replica_mapping_get_next_replid(rmctx->tdb) == 0xffff) {
-		mapistore_replica_mapping_set_next_replid(rmctx->tdb, 0x3);
+	if (default_replica_mapping_url &&
+	    strncmp(default_replica_mapping_url, "mysql://", strlen("mysql://")) == 0) {
+		retval = mapistore_replica_mapping_open_mysql(rmctx, default_replica_mapping_url);
+	} else {
+		if (default_replica_mapping_url) {
+			OC_DEBUG(0, "Unknown replica mapping backend %s, falling back to TDB",
+				 default_replica_mapping_url);
+		}
+		retval = mapistore_replica_mapping_open_tdb(rmctx);
 	}
+	MAPISTORE_RETVAL_IF(retval, retval, rmctx);
 
-	talloc_free(mem_ctx);
+	/* Step 3. Load existing mappings once for the session */
+	retval = mapistore_replica_mapping_load(rmctx);
+	MAPISTORE_RETVAL_IF(retval, retval, rmctx);
+
+	DLIST_ADD_END(mstore_ctx->replica_mapping_list, rmctx, struct replica_mapping_context_list *);
+
+	*rmctxp = rmctx;
 
 	return MAPISTORE_SUCCESS;
 }
@@ -205,6 +307,7 @@ static uint16_t mapistore_replica_mapping_get_next_replid(struct tdb_context *td
 	replid_data = tdb_fetch(tdb, key);
 
 	tmp_data = talloc_strndup(NULL, (char *) replid_data.dptr, replid_data.dsize);
+	free(replid_data.dptr);
 	replid = strtoul(tmp_data, NULL, 16);
 	talloc_free(tmp_data);
 
@@ -237,6 +340,7 @@ static enum mapistore_error mapistore_replica_mapping_search_guid(struct tdb_con
 	TDB_DATA	guid_key;
 	TDB_DATA	replid_key;
 	void		*mem_ctx;
+	char		*tmp_data;
 	int		ret;
 
 	mem_ctx = talloc_zero(NULL, void);
@@ -251,17 +355,317 @@ static enum mapistore_error mapistore_replica_mapping_search_guid(struct tdb_con
 	}
 
 	replid_key = tdb_fetch(tdb, guid_key);
-	*replidP = strtoul((char *) replid_key.dptr + 2, NULL, 16);
+	tmp_data = talloc_strndup(mem_ctx, (char *) replid_key.dptr, replid_key.dsize);
+	free(replid_key.dptr);
+	MAPISTORE_RETVAL_IF(!tmp_data, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	*replidP = strtoul(tmp_data + 2, NULL, 16);
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error mapistore_replica_mapping_search_replid(struct tdb_context *tdb, uint16_t replid, struct GUID *guidP)
+{
+	TDB_DATA	guid_key;
+	TDB_DATA	replid_key;
+	void		*mem_ctx;
+	char		*tmp_data;
+	int		ret;
+
+	mem_ctx = talloc_zero(NULL, void);
+
+	replid_key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%.4x", replid);
+	replid_key.dsize = strlen((const char *) replid_key.dptr);
+
+	ret = tdb_exists(tdb, replid_key);
+	if (!ret) {
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERROR;
+	}
+
+	guid_key = tdb_fetch(tdb, replid_key);
+	tmp_data = talloc_strndup(mem_ctx, (char *) guid_key.dptr, guid_key.dsize);
+	free(guid_key.dptr);
+	MAPISTORE_RETVAL_IF(!tmp_data, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	ret = NT_STATUS_IS_OK(GUID_from_string(tmp_data, guidP));
+
+	talloc_free(mem_ctx);
+
+	return ret ? MAPISTORE_SUCCESS : MAPISTORE_ERROR;
+}
+
+/**
+   \details Search the in-memory mapping table for a replica guid
+
+   \param rmctx pointer to the replica mapping context
+   \param guidP the replica guid to lookup
+
+   \return pointer to the matching entry on success, otherwise NULL
+ */
+static struct replica_mapping_entry *mapistore_replica_mapping_cache_guid(struct replica_mapping_context_list *rmctx, const struct GUID *guidP)
+{
+	uint32_t	i;
+
+	for (i = 0; i < rmctx->entries_count; i++) {
+		if (GUID_equal(&rmctx->entries[i].guid, guidP)) {
+			return &rmctx->entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+   \details Search the in-memory mapping table for a replica id
+
+   \param rmctx pointer to the replica mapping context
+   \param replid the replica id to lookup
+
+   \return pointer to the matching entry on success, otherwise NULL
+ */
+static struct replica_mapping_entry *mapistore_replica_mapping_cache_replid(struct replica_mapping_context_list *rmctx, uint16_t replid)
+{
+	uint32_t	i;
+
+	for (i = 0; i < rmctx->entries_count; i++) {
+		if (rmctx->entries[i].replid == replid) {
+			return &rmctx->entries[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+   \details Add a replica guid/id pair to the in-memory mapping table
+
+   \param rmctx pointer to the replica mapping context
+   \param guidP the replica guid
+   \param replid the replica id
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_replica_mapping_cache_add(struct replica_mapping_context_list *rmctx, const struct GUID *guidP, uint16_t replid)
+{
+	struct replica_mapping_entry	*entries;
+
+	if (mapistore_replica_mapping_cache_replid(rmctx, replid)) {
+		return MAPISTORE_SUCCESS;
+	}
+
+	entries = talloc_realloc(rmctx, rmctx->entries, struct replica_mapping_entry,
+				 rmctx->entries_count + 1);
+	MAPISTORE_RETVAL_IF(!entries, MAPISTORE_ERR_NO_MEMORY, NULL);
+	entries[rmctx->entries_count].replid = replid;
+	entries[rmctx->entries_count].guid = *guidP;
+	rmctx->entries = entries;
+	rmctx->entries_count++;
+
+	return MAPISTORE_SUCCESS;
+}
+
+static int mapistore_replica_mapping_load_tdb(struct tdb_context *tdb, TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct replica_mapping_context_list	*rmctx = private_data;
+	char					*tmp_key;
+	char					*tmp_data;
+	struct GUID				guid;
+
+	/* Only replid -> GUID records are loaded: "0x%.4x" => GUID */
+	if (key.dsize != 6 || strncmp((const char *) key.dptr, "0x", 2) != 0) {
+		return 0;
+	}
+
+	tmp_key = talloc_strndup(rmctx, (char *) key.dptr, key.dsize);
+	tmp_data = talloc_strndup(rmctx, (char *) data.dptr, data.dsize);
+	if (tmp_key && tmp_data && NT_STATUS_IS_OK(GUID_from_string(tmp_data, &guid))) {
+		mapistore_replica_mapping_cache_add(rmctx, &guid, strtoul(tmp_key + 2, NULL, 16));
+	}
+	talloc_free(tmp_key);
+	talloc_free(tmp_data);
+
+	return 0;
+}
+
+static enum mapistore_error mapistore_replica_mapping_load_mysql(struct replica_mapping_context_list *rmctx)
+{
+	TALLOC_CTX		*mem_ctx;
+	MYSQL_RES		*res;
+	MYSQL_ROW		row;
+	enum MYSQLRESULT	ret;
+	char			*sql;
+	struct GUID		guid;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	sql = talloc_asprintf(mem_ctx, "SELECT replid, guid FROM " MAPISTORE_REPLICA_MAPPING_TABLE
+			      " WHERE username = '%s'", _sql(mem_ctx, rmctx->username));
+	MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	ret = select_without_fetch((MYSQL *)rmctx->conn, sql, &res);
+	if (ret == MYSQL_NOT_FOUND) {
+		talloc_free(mem_ctx);
+		return MAPISTORE_SUCCESS;
+	}
+	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERR_DATABASE_OPS, mem_ctx);
+
+	while ((row = mysql_fetch_row(res)) != NULL) {
+		if (row[0] && row[1] && NT_STATUS_IS_OK(GUID_from_string(row[1], &guid))) {
+			mapistore_replica_mapping_cache_add(rmctx, &guid, strtoul(row[0], NULL, 10));
+		}
+	}
+	mysql_free_result(res);
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Load all the mappings of the user in memory
+
+   \param rmctx pointer to the replica mapping context
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_replica_mapping_load(struct replica_mapping_context_list *rmctx)
+{
+	if (rmctx->conn) {
+		return mapistore_replica_mapping_load_mysql(rmctx);
+	}
+
+	if (tdb_traverse_read(rmctx->tdb, mapistore_replica_mapping_load_tdb, rmctx) < 0) {
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Search the replica id of a guid in the MySQL database
+
+   \param rmctx pointer to the replica mapping context
+   \param guidP the replica guid
+   \param replidP pointer to the returned replica id
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_replica_mapping_mysql_search_guid(struct replica_mapping_context_list *rmctx, const struct GUID *guidP, uint16_t *replidP)
+{
+	TALLOC_CTX		*mem_ctx;
+	char			*sql;
+	uint64_t		replid;
+	enum MYSQLRESULT	ret;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	sql = talloc_asprintf(mem_ctx, "SELECT replid FROM " MAPISTORE_REPLICA_MAPPING_TABLE
+			      " WHERE username = '%s' AND guid = '%s'",
+			      _sql(mem_ctx, rmctx->username), GUID_string(mem_ctx, guidP));
+	MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	ret = select_first_uint((MYSQL *)rmctx->conn, sql, &replid);
+	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERROR, mem_ctx);
+	*replidP = (uint16_t) replid;
+
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Search the guid of a replica id in the MySQL database
+
+   \param rmctx pointer to the replica mapping context
+   \param replid the replica id
+   \param guidP pointer to the returned replica guid
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_replica_mapping_mysql_search_replid(struct replica_mapping_context_list *rmctx, uint16_t replid, struct GUID *guidP)
+{
+	TALLOC_CTX		*mem_ctx;
+	char			*sql;
+	const char		*guid;
+	enum MYSQLRESULT	ret;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	sql = talloc_asprintf(mem_ctx, "SELECT guid FROM " MAPISTORE_REPLICA_MAPPING_TABLE
+			      " WHERE username = '%s' AND replid = %u",
+			      _sql(mem_ctx, rmctx->username), replid);
+	MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	ret = select_first_string(mem_ctx, (MYSQL *)rmctx->conn, sql, &guid);
+	MAPISTORE_RETVAL_IF(ret != MYSQL_SUCCESS, MAPISTORE_ERROR, mem_ctx);
+	MAPISTORE_RETVAL_IF(!NT_STATUS_IS_OK(GUID_from_string(guid, guidP)), MAPISTORE_ERROR, mem_ctx);
 
 	talloc_free(mem_ctx);
 
 	return MAPISTORE_SUCCESS;
 }
 
+/**
+   \details Allocate a replica id for a guid in the MySQL database
+
+   The next replica id is computed by the INSERT itself so several
+   nodes can allocate ids for the same user. The unique keys on
+   (username, replid) and (username, guid) discard the row of a
+   concurrent writer, in which case the allocation is attempted again.
+
+   \param rmctx pointer to the replica mapping context
+   \param guidP the replica guid
+   \param replidP pointer to the returned replica id
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_replica_mapping_mysql_allocate(struct replica_mapping_context_list *rmctx, const struct GUID *guidP, uint16_t *replidP)
+{
+	TALLOC_CTX		*mem_ctx;
+	char			*sql;
+	const char		*username;
+	uint32_t		i;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	username = _sql(mem_ctx, rmctx->username);
+	sql = talloc_asprintf(mem_ctx, "INSERT IGNORE INTO " MAPISTORE_REPLICA_MAPPING_TABLE
+			      " (username, replid, guid) SELECT '%s', COALESCE(MAX(replid), 2) + 1, '%s'"
+			      " FROM " MAPISTORE_REPLICA_MAPPING_TABLE " WHERE username = '%s'",
+			      username, GUID_string(mem_ctx, guidP), username);
+	MAPISTORE_RETVAL_IF(!sql, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	for (i = 0; i < REPLICA_MAPPING_MYSQL_RETRIES; i++) {
+		if (execute_query((MYSQL *)rmctx->conn, sql) != MYSQL_SUCCESS) {
+			break;
+		}
+		if (mapistore_replica_mapping_mysql_search_guid(rmctx, guidP, replidP) == MAPISTORE_SUCCESS) {
+			talloc_free(mem_ctx);
+			return MAPISTORE_SUCCESS;
+		}
+	}
+
+	OC_DEBUG(1, "Unable to allocate a replica id for %s", rmctx->username);
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_ERR_DATABASE_OPS;
+}
+
 /**
    \details Search a replica guid in the database, creates it if it does not exist
 
+   Lookups are served from the in-memory table loaded when the user
+   context was opened. Unknown guids are searched in the database, in
+   case another process added them, before a new replica id is
+   allocated and written through.
+
    \param mstore_ctx pointer to the mapistore context
+   \param username the owner of the mapping
    \param guidP the replica guid
    \param replidP pointer to the returned replica id
 
@@ -269,28 +673,42 @@ static enum mapistore_error mapistore_replica_mapping_search_guid(struct tdb_con
  */
 _PUBLIC_ enum mapistore_error mapistore_replica_mapping_guid_to_replid(struct mapistore_context *mstore_ctx, const char *username, const struct GUID *guidP, uint16_t *replidP)
 {
-	int		ret;
-	uint16_t	new_replid;
+	int				ret;
+	uint16_t			new_replid;
 	struct replica_mapping_context_list *list;
+	struct replica_mapping_entry	*entry;
 
 	ret = mapistore_replica_mapping_add(mstore_ctx, username, &list);
 	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(!list, MAPISTORE_ERROR, NULL);
 
-	ret = mapistore_replica_mapping_search_guid(list->tdb, guidP, replidP);
-	if (ret == MAPISTORE_SUCCESS) {
-		return ret;
+	entry = mapistore_replica_mapping_cache_guid(list, guidP);
+	if (entry) {
+		*replidP = entry->replid;
+		return MAPISTORE_SUCCESS;
 	}
 
-	new_replid = mapistore_replica_mapping_get_next_replid(list->tdb);
-	if (new_replid == 0xffff) { /* should never occur */
-		oc_log(OC_LOG_FATAL, "next replica id is not configured for this database");
-		return MAPISTORE_ERROR;
+	if (list->conn) {
+		ret = mapistore_replica_mapping_mysql_search_guid(list, guidP, &new_replid);
+		if (ret != MAPISTORE_SUCCESS) {
+			ret = mapistore_replica_mapping_mysql_allocate(list, guidP, &new_replid);
+			MAPISTORE_RETVAL_IF(ret, ret, NULL);
+		}
+	} else {
+		ret = mapistore_replica_mapping_search_guid(list->tdb, guidP, &new_replid);
+		if (ret != MAPISTORE_SUCCESS) {
+			new_replid = mapistore_replica_mapping_get_next_replid(list->tdb);
+			if (new_replid == 0xffff) { /* should never occur */
+				oc_log(OC_LOG_FATAL, "next replica id is not configured for this database");
+				return MAPISTORE_ERROR;
+			}
+
+			mapistore_replica_mapping_add_pair(list->tdb, guidP, new_replid);
+			mapistore_replica_mapping_set_next_replid(list->tdb, new_replid + 1);
+		}
 	}
 
-	mapistore_replica_mapping_add_pair(list->tdb, guidP, new_replid);
-	mapistore_replica_mapping_set_next_replid(list->tdb, new_replid + 1);
-
+	mapistore_replica_mapping_cache_add(list, guidP, new_replid);
 	*replidP = new_replid;
 
 	return MAPISTORE_SUCCESS;
@@ -300,6 +718,7 @@ _PUBLIC_ enum mapistore_error mapistore_replica_mapping_guid_to_replid(struct ma
    \details Search a replica id in the database
 
    \param mstore_ctx pointer to the mapistore context
+   \param username the owner of the mapping
    \param replid the replica id
    \param guidP pointer to the returned replica guid
 
@@ -307,30 +726,28 @@ _PUBLIC_ enum mapistore_error mapistore_replica_mapping_guid_to_replid(struct ma
  */
 _PUBLIC_ enum mapistore_error mapistore_replica_mapping_replid_to_guid(struct mapistore_context *mstore_ctx, const char *username, uint16_t replid, struct GUID *guidP)
 {
-	void					*mem_ctx;
-	TDB_DATA				guid_key, replid_key;
 	int					ret;
 	struct replica_mapping_context_list	*list;
+	struct replica_mapping_entry		*entry;
 
 	ret = mapistore_replica_mapping_add(mstore_ctx, username, &list);
 	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERROR, NULL);
 	MAPISTORE_RETVAL_IF(!list, MAPISTORE_ERROR, NULL);
 
-	mem_ctx = talloc_zero(NULL, void);
-
-	replid_key.dptr = (unsigned char *) talloc_asprintf(mem_ctx, "0x%.4x", replid);
-	replid_key.dsize = strlen((const char *) replid_key.dptr);
-
-	ret = tdb_exists(list->tdb, replid_key);
-	if (!ret) {
-		talloc_free(mem_ctx);
-		return MAPISTORE_ERROR;
+	entry = mapistore_replica_mapping_cache_replid(list, replid);
+	if (entry) {
+		*guidP = entry->guid;
+		return MAPISTORE_SUCCESS;
 	}
 
-	guid_key = tdb_fetch(list->tdb, replid_key);
-	GUID_from_string((char *) guid_key.dptr, guidP);
+	if (list->conn) {
+		ret = mapistore_replica_mapping_mysql_search_replid(list, replid, guidP);
+	} else {
+		ret = mapistore_replica_mapping_search_replid(list->tdb, replid, guidP);
+	}
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERROR, NULL);
 
-	talloc_free(mem_ctx);
+	mapistore_replica_mapping_cache_add(list, guidP, replid);
 
 	return MAPISTORE_SUCCESS;
 }
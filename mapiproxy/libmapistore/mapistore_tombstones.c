@@ -0,0 +1,463 @@
+/*
+   OpenChange Storage Abstraction Layer library
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file mapistore_tombstones.c
+
+   \brief Log of the messages deleted from folders
+
+   Each folder has a record in a TDB file of the mailbox owner's
+   mapistore directory listing the messages deleted or moved out of it,
+   sorted by the change number allocated for the deletion. The messages
+   deleted since the change number a client has seen are read from the
+   end of the list, without asking the backend to compare the folder
+   contents with the client state.
+
+   A log only knows the deletions made after its creation: the record
+   keeps the change number from which it is complete. Compaction drops
+   the oldest entries and moves this change number forward, clients
+   whose state is older are answered by the backend.
+
+   Change numbers use the format of mapistore_folder_get_deleted_fmids:
+   the global counter shifted by 16 bits with the replica identifier in
+   the lower bits.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "mapistore.h"
+#include "mapistore_errors.h"
+#include "mapistore_private.h"
+#include "libmapi/libmapi_private.h"
+
+#include <tdb.h>
+
+#define	MAPISTORE_TOMBSTONES_VERSION	1
+#define	MAPISTORE_TOMBSTONES_KEY_SIZE	9
+#define	MAPISTORE_TOMBSTONES_LOG	'L'
+
+struct mapistore_tombstone {
+	uint64_t	cn;
+	uint64_t	mid;
+	uint64_t	deleted;
+};
+
+struct mapistore_tombstones_log {
+	uint64_t			complete_cn;
+	uint32_t			count;
+	struct mapistore_tombstone	*entries;
+};
+
+static bool	tombstones_enabled = false;
+static uint32_t	tombstones_max_age = MAPISTORE_TOMBSTONES_MAX_AGE;
+
+/**
+   \details Configure the deleted messages log
+
+   \param enabled whether deletions are logged and read from the log
+   \param max_age number of seconds entries are kept, 0 to only limit
+   the number of entries
+ */
+_PUBLIC_ void mapistore_set_tombstones(bool enabled, uint32_t max_age)
+{
+	tombstones_enabled = enabled;
+	tombstones_max_age = max_age;
+}
+
+/**
+   \details Tell whether the deleted messages log is enabled
+
+   \return true if deletions are logged, otherwise false
+ */
+_PUBLIC_ bool mapistore_tombstones_enabled(void)
+{
+	return tombstones_enabled;
+}
+
+static struct tdb_context *mapistore_tombstones_open(TALLOC_CTX *mem_ctx, const char *username, int open_flags)
+{
+	struct tdb_context	*tdb;
+	char			*dbpath;
+
+	if (open_flags & O_CREAT) {
+		dbpath = talloc_asprintf(mem_ctx, "%s/%s", mapistore_get_mapping_path(), username);
+		if (!dbpath) return NULL;
+		mkdir(dbpath, 0700);
+		talloc_free(dbpath);
+	}
+
+	dbpath = talloc_asprintf(mem_ctx, "%s/%s/" MAPISTORE_DB_TOMBSTONES,
+				 mapistore_get_mapping_path(), username);
+	if (!dbpath) return NULL;
+
+	tdb = tdb_open(dbpath, 0, 0, open_flags, 0600);
+	if (!tdb && (open_flags & O_CREAT)) {
+		OC_DEBUG(3, "%s (%s)", strerror(errno), dbpath);
+	}
+	talloc_free(dbpath);
+
+	return tdb;
+}
+
+static TDB_DATA mapistore_tombstones_key(uint8_t *buffer, uint64_t fid)
+{
+	TDB_DATA	key;
+	int		i;
+
+	buffer[0] = MAPISTORE_TOMBSTONES_LOG;
+	for (i = 8; i > 0; i--) {
+		buffer[i] = fid & 0xff;
+		fid >>= 8;
+	}
+	key.dptr = buffer;
+	key.dsize = MAPISTORE_TOMBSTONES_KEY_SIZE;
+
+	return key;
+}
+
+/**
+   \details Read the log of a folder
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if the
+   folder has no log, otherwise MAPISTORE error
+ */
+static enum mapistore_error mapistore_tombstones_log_fetch(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, uint64_t fid,
+							   struct mapistore_tombstones_log **logp)
+{
+	struct mapistore_tombstones_log	*log;
+	struct ndr_pull			*ndr;
+	uint8_t				buffer[MAPISTORE_TOMBSTONES_KEY_SIZE];
+	TDB_DATA			data;
+	DATA_BLOB			blob;
+	uint8_t				version;
+	uint32_t			i;
+
+	data = tdb_fetch(tdb, mapistore_tombstones_key(buffer, fid));
+	MAPISTORE_RETVAL_IF(!data.dptr, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	log = talloc_zero(mem_ctx, struct mapistore_tombstones_log);
+	if (!log) {
+		free(data.dptr);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	blob.data = data.dptr;
+	blob.length = data.dsize;
+	ndr = ndr_pull_init_blob(&blob, log);
+	if (!ndr) {
+		free(data.dptr);
+		talloc_free(log);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+
+	if (ndr_pull_uint8(ndr, NDR_SCALARS, &version) != NDR_ERR_SUCCESS || version != MAPISTORE_TOMBSTONES_VERSION
+	    || ndr_pull_hyper(ndr, NDR_SCALARS, &log->complete_cn) != NDR_ERR_SUCCESS
+	    || ndr_pull_uint32(ndr, NDR_SCALARS, &log->count) != NDR_ERR_SUCCESS
+	    || log->count > data.dsize / 24) {
+		goto corrupted;
+	}
+
+	log->entries = talloc_array(log, struct mapistore_tombstone, log->count + 1);
+	if (!log->entries) {
+		free(data.dptr);
+		talloc_free(log);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	for (i = 0; i < log->count; i++) {
+		if (ndr_pull_hyper(ndr, NDR_SCALARS, &log->entries[i].cn) != NDR_ERR_SUCCESS
+		    || ndr_pull_hyper(ndr, NDR_SCALARS, &log->entries[i].mid) != NDR_ERR_SUCCESS
+		    || ndr_pull_hyper(ndr, NDR_SCALARS, &log->entries[i].deleted) != NDR_ERR_SUCCESS) {
+			goto corrupted;
+		}
+	}
+	free(data.dptr);
+	talloc_free(ndr);
+
+	*logp = log;
+
+	return MAPISTORE_SUCCESS;
+
+corrupted:
+	OC_DEBUG(3, "corrupted deleted messages log for folder 0x%.16"PRIx64, fid);
+	free(data.dptr);
+	talloc_free(log);
+	return MAPISTORE_ERR_CORRUPTED;
+}
+
+static enum mapistore_error mapistore_tombstones_log_store(TALLOC_CTX *mem_ctx, struct tdb_context *tdb, uint64_t fid,
+							   const struct mapistore_tombstones_log *log)
+{
+	struct ndr_push		*ndr;
+	uint8_t			buffer[MAPISTORE_TOMBSTONES_KEY_SIZE];
+	TDB_DATA		data;
+	uint32_t		i;
+	int			ret;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	MAPISTORE_RETVAL_IF(!ndr, MAPISTORE_ERR_NO_MEMORY, NULL);
+	ndr_push_uint8(ndr, NDR_SCALARS, MAPISTORE_TOMBSTONES_VERSION);
+	ndr_push_hyper(ndr, NDR_SCALARS, log->complete_cn);
+	ndr_push_uint32(ndr, NDR_SCALARS, log->count);
+	for (i = 0; i < log->count; i++) {
+		ndr_push_hyper(ndr, NDR_SCALARS, log->entries[i].cn);
+		ndr_push_hyper(ndr, NDR_SCALARS, log->entries[i].mid);
+		ndr_push_hyper(ndr, NDR_SCALARS, log->entries[i].deleted);
+	}
+
+	data.dptr = ndr->data;
+	data.dsize = ndr->offset;
+	ret = tdb_store(tdb, mapistore_tombstones_key(buffer, fid), data, TDB_REPLACE);
+	talloc_free(ndr);
+	MAPISTORE_RETVAL_IF(ret, MAPISTORE_ERR_DATABASE_OPS, NULL);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Index of the first entry of the log with a change number
+   greater than cn
+ */
+static uint32_t mapistore_tombstones_log_search(const struct mapistore_tombstones_log *log, uint64_t cn)
+{
+	uint32_t	low = 0, high = log->count, middle;
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (log->entries[middle].cn <= cn) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+/**
+   \details Drop the entries beyond the size limit and the ones older
+   than the maximum age. The log stays complete from the change number
+   of the last dropped entry.
+ */
+static void mapistore_tombstones_log_compact(struct mapistore_tombstones_log *log, time_t now)
+{
+	uint32_t	dropped = 0;
+
+	while (dropped < log->count
+	       && (log->count - dropped > MAPISTORE_TOMBSTONES_MAX
+		   || (tombstones_max_age && log->entries[dropped].deleted + tombstones_max_age < (uint64_t) now))) {
+		if (log->entries[dropped].cn > log->complete_cn) {
+			log->complete_cn = log->entries[dropped].cn;
+		}
+		dropped++;
+	}
+
+	if (dropped) {
+		memmove(log->entries, log->entries + dropped, (log->count - dropped) * sizeof (struct mapistore_tombstone));
+		log->count -= dropped;
+	}
+}
+
+/**
+   \details Record messages deleted or moved out of a folder. A folder
+   without log gets one complete from the given change number.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+   \param cn the change number allocated for the deletion
+   \param count number of message identifiers
+   \param mids array of message identifiers
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_tombstones_add(struct mapistore_context *mstore_ctx, const char *username,
+						       uint64_t fid, uint64_t cn, uint32_t count, const uint64_t *mids)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct tdb_context		*tdb;
+	struct mapistore_tombstones_log	*log;
+	struct mapistore_tombstone	*entries;
+	enum mapistore_error		ret;
+	time_t				now;
+	uint32_t			pos, i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username || !cn, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!count || !tombstones_enabled, MAPISTORE_SUCCESS, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_tombstones_open(mem_ctx, username, O_RDWR|O_CREAT);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_DATABASE_INIT, mem_ctx);
+
+	if (tdb_transaction_start(tdb) != 0) {
+		tdb_close(tdb);
+		talloc_free(mem_ctx);
+		return MAPISTORE_ERR_DATABASE_OPS;
+	}
+
+	ret = mapistore_tombstones_log_fetch(mem_ctx, tdb, fid, &log);
+	if (ret == MAPISTORE_ERR_NOT_FOUND || ret == MAPISTORE_ERR_CORRUPTED) {
+		log = talloc_zero(mem_ctx, struct mapistore_tombstones_log);
+		if (!log) {
+			ret = MAPISTORE_ERR_NO_MEMORY;
+			goto end;
+		}
+		log->complete_cn = cn - 1;
+	} else if (ret != MAPISTORE_SUCCESS) {
+		goto end;
+	}
+
+	/* Sessions allocate change numbers concurrently: insert after
+	   the entries with a lower or equal change number */
+	entries = talloc_realloc(log, log->entries, struct mapistore_tombstone, log->count + count);
+	if (!entries) {
+		ret = MAPISTORE_ERR_NO_MEMORY;
+		goto end;
+	}
+	log->entries = entries;
+	pos = mapistore_tombstones_log_search(log, cn);
+	memmove(log->entries + pos + count, log->entries + pos, (log->count - pos) * sizeof (struct mapistore_tombstone));
+
+	now = time(NULL);
+	for (i = 0; i < count; i++) {
+		log->entries[pos + i].cn = cn;
+		log->entries[pos + i].mid = mids[i];
+		log->entries[pos + i].deleted = now;
+	}
+	log->count += count;
+
+	mapistore_tombstones_log_compact(log, now);
+	ret = mapistore_tombstones_log_store(mem_ctx, tdb, fid, log);
+
+end:
+	if (ret == MAPISTORE_SUCCESS) {
+		if (tdb_transaction_commit(tdb) != 0) {
+			ret = MAPISTORE_ERR_DATABASE_OPS;
+		}
+	} else {
+		tdb_transaction_cancel(tdb);
+	}
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Drop the log of a folder, for deleted folders and when a
+   deletion could not be recorded
+
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_tombstones_folder_reset(struct mapistore_context *mstore_ctx, const char *username, uint64_t fid)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct tdb_context	*tdb;
+	uint8_t			buffer[MAPISTORE_TOMBSTONES_KEY_SIZE];
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_tombstones_open(mem_ctx, username, O_RDWR);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_SUCCESS, mem_ctx);
+
+	tdb_delete(tdb, mapistore_tombstones_key(buffer, fid));
+	tdb_close(tdb);
+	talloc_free(mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Get the messages deleted from a folder after a change number
+
+   \param mem_ctx pointer to the memory context
+   \param mstore_ctx pointer to the mapistore context
+   \param username the mailbox owner
+   \param fid the folder identifier
+   \param change_num the change number the client has seen
+   \param fmidsp pointer to the returned array of message identifiers
+   \param cnp pointer to the highest change number of the returned
+   deletions, change_num when there are none
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_FOUND if
+   the log is disabled or does not go back to change_num, otherwise
+   MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error mapistore_tombstones_get(TALLOC_CTX *mem_ctx, struct mapistore_context *mstore_ctx,
+						       const char *username, uint64_t fid, uint64_t change_num,
+						       struct UI8Array_r **fmidsp, uint64_t *cnp)
+{
+	TALLOC_CTX			*local_mem_ctx;
+	struct tdb_context		*tdb;
+	struct mapistore_tombstones_log	*log;
+	struct UI8Array_r		*fmids;
+	enum mapistore_error		ret;
+	uint32_t			pos, i;
+
+	/* Sanity checks */
+	MAPISTORE_SANITY_CHECKS(mstore_ctx, NULL);
+	MAPISTORE_RETVAL_IF(!username || !fmidsp || !cnp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!tombstones_enabled, MAPISTORE_ERR_NOT_FOUND, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	tdb = mapistore_tombstones_open(local_mem_ctx, username, O_RDONLY);
+	MAPISTORE_RETVAL_IF(!tdb, MAPISTORE_ERR_NOT_FOUND, local_mem_ctx);
+
+	ret = mapistore_tombstones_log_fetch(local_mem_ctx, tdb, fid, &log);
+	tdb_close(tdb);
+	MAPISTORE_RETVAL_IF(ret == MAPISTORE_ERR_CORRUPTED, MAPISTORE_ERR_NOT_FOUND, local_mem_ctx);
+	MAPISTORE_RETVAL_IF(ret, ret, local_mem_ctx);
+	MAPISTORE_RETVAL_IF(change_num < log->complete_cn, MAPISTORE_ERR_NOT_FOUND, local_mem_ctx);
+
+	fmids = talloc_zero(mem_ctx, struct UI8Array_r);
+	MAPISTORE_RETVAL_IF(!fmids, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+
+	pos = mapistore_tombstones_log_search(log, change_num);
+	fmids->lpui8 = talloc_array(fmids, uint64_t, log->count - pos + 1);
+	if (!fmids->lpui8) {
+		talloc_free(fmids);
+		talloc_free(local_mem_ctx);
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	for (i = pos; i < log->count; i++) {
+		fmids->lpui8[fmids->cValues++] = log->entries[i].mid;
+	}
+
+	*cnp = log->count > pos ? log->entries[log->count - 1].cn : change_num;
+	*fmidsp = fmids;
+	talloc_free(local_mem_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
@@ -110,8 +110,10 @@ static void cache_dump_stream_stat(struct mpm_stream *stream)
 
 	if (stream->ahead == true) {
 		stage = "[read ahead]";
-	} else if ((stream->ahead == false) && (stream->cached == true)) {
+	} else if (stream->state == MPM_STREAM_CACHED) {
 		stage = "[cached mode]";
+	} else if (stream->state == MPM_STREAM_SHARED) {
+		stage = "[shared fetch]";
 	} else {
 		stage = "[non cached]";
 	}
@@ -125,13 +127,14 @@ static void cache_dump_stream_stat(struct mpm_stream *stream)
 /**
    \details
 
-   1. close the existing FILE *
-   2. build complete file path
-   3. replace __FILE__ arguments with complete file path
-   4. call execve
-   5. stat the sync'd file
-   6. open the stream again
-   7. mark the file as cached
+   1. build the path of the stream key in the store
+   2. replace __FILE__ arguments with this path
+   3. call execve
+   4. stat the sync'd file
+   5. move it into the store and serve the stream from there
+
+   The remote MAPIProxy links the same path to the stream content,
+   the command must therefore follow symbolic links.
 
    \param stream pointer on the mpm_stream entry
  */
@@ -140,11 +143,13 @@ static NTSTATUS cache_exec_sync_cmd(struct mpm_stream *stream)
 	uint32_t	i;
 	int		ret = 0;
 	char		**args;
+	char		*file;
 	struct stat	sb;
 	pid_t		pid;
 	int		status;
 
-	mpm_cache_stream_close(stream);
+	file = talloc_asprintf((TALLOC_CTX *)mpm, "%s/%s/%s", mpm->dbpath, MPM_DB_KEYS, stream->key);
+	NT_STATUS_HAVE_NO_MEMORY(file);
 
 	for (i = 0; mpm->sync_cmd[i]; i++);
 
@@ -152,7 +157,7 @@ static NTSTATUS cache_exec_sync_cmd(struct mpm_stream *stream)
 
 	for (i = 0; mpm->sync_cmd[i]; i++){
 		if (strstr(mpm->sync_cmd[i], "__FILE__")) {
-			args[i] = string_sub_talloc((TALLOC_CTX *)args, mpm->sync_cmd[i], "__FILE__", stream->filename);
+			args[i] = string_sub_talloc((TALLOC_CTX *)args, mpm->sync_cmd[i], "__FILE__", file);
 		} else {
 			args[i] = talloc_strdup((TALLOC_CTX *)args, mpm->sync_cmd[i]);
 		}
@@ -178,23 +183,30 @@ static NTSTATUS cache_exec_sync_cmd(struct mpm_stream *stream)
 	talloc_free(args);
 	if (ret == -1) {
 		perror("execve: ");
+		talloc_free(file);
 		return NT_STATUS_INVALID_PARAMETER;
 	}
 
-	ret = stat(stream->filename, &sb);
-	if (ret == -1) {
+	ret = lstat(file, &sb);
+	if (ret == -1 || !S_ISREG(sb.st_mode)) {
 		perror("stat: ");
+		talloc_free(file);
 		return NT_STATUS_INVALID_PARAMETER;
 	}
 
 	if (sb.st_size != stream->StreamSize) {
 		OC_DEBUG(0, "Sync'd file size is 0x%x and 0x%x was expected\n",
 			  (uint32_t)sb.st_size, stream->StreamSize);
+		unlink(file);
+		talloc_free(file);
 		return NT_STATUS_INVALID_PARAMETER;
 	}
 
-	mpm_cache_stream_open(mpm, stream);
-	stream->cached = true;
+	if (!NT_STATUS_IS_OK(mpm_cache_stream_commit(mpm, stream, file))) {
+		talloc_free(file);
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+	talloc_free(file);
 
 	return NT_STATUS_OK;
 }
@@ -252,7 +264,6 @@ static NTSTATUS cache_pull_Release(struct dcesrv_call_state *dce_call,
 							talloc_free(server_id_printable);
 							mpm_session_release(stream->session);
 							mpm_cache_stream_close(stream);
-							talloc_free(stream->filename);
 							DLIST_REMOVE(mpm->streams, stream);
 							talloc_free(stream);
 							stream = mpm->streams;
@@ -282,7 +293,6 @@ static NTSTATUS cache_pull_Release(struct dcesrv_call_state *dce_call,
 					mpm_session_release(stream->session);
 					mpm_cache_stream_close(stream);
 					DLIST_REMOVE(mpm->streams, stream);
-					talloc_free(stream->filename);
 					talloc_free(stream);
 					stream = mpm->streams;
 				} else {
@@ -318,7 +328,6 @@ static NTSTATUS cache_pull_Release(struct dcesrv_call_state *dce_call,
 					mpm_session_release(stream->session);
 					mpm_cache_stream_close(stream);
 					DLIST_REMOVE(mpm->streams, stream);
-					talloc_free(stream->filename);
 					talloc_free(stream);
 					stream = mpm->streams;
 				} else {
@@ -344,7 +353,6 @@ static NTSTATUS cache_pull_Release(struct dcesrv_call_state *dce_call,
 			mpm_session_release(stream->session);
 			mpm_cache_stream_close(stream);
 			DLIST_REMOVE(mpm->streams, stream);
-			talloc_free(stream->filename);
 			talloc_free(stream);
 			return NT_STATUS_OK;
 		}
@@ -441,7 +449,6 @@ static NTSTATUS cache_push_OpenMessage(struct dcesrv_call_state *dce_call,
 		if ((el->FolderId == request.FolderId) && (el->MessageId == request.MessageId) &&
 		    (mpm_session_cmp(el->session, dce_call) == true)) {
 			if (mapi_repl.error_code == MAPI_E_SUCCESS) {
-				mpm_cache_ldb_add_message((TALLOC_CTX *)mpm, mpm->ldb_ctx, el);
 				el->handle = mapi_response->handles[request.handle_idx];
 				server_id_printable = server_id_str(NULL, &(el->session->server_id));
 				OC_DEBUG(2, "* [s(%s),c(0x%x)] Add: Message 0x%"PRIx64" 0x%"PRIx64" 0x%x",
@@ -579,7 +586,6 @@ static NTSTATUS cache_push_OpenAttach(struct dcesrv_call_state *dce_call,
 					  server_id_printable, el->session->context_id, el->AttachmentID, el->handle,
 					  el->parent_handle);
 				talloc_free(server_id_printable);
-				mpm_cache_ldb_add_attachment((TALLOC_CTX *)mpm, mpm->ldb_ctx, el);
 			} else {
 			        server_id_printable = server_id_str(NULL, &(el->session->server_id));
 				OC_DEBUG(0, "* [s(%s),c(0x%x)] Del: Attachment OpenAttach returned %s",
@@ -632,8 +638,9 @@ static NTSTATUS cache_pull_OpenStream(struct dcesrv_call_state *dce_call,
 	for (attach = mpm->attachments; attach; attach = attach->next) {
 		if ((mpm_session_cmp(attach->session, dce_call) == true) &&
 		    mapi_request->handles[mapi_req.handle_idx] == attach->handle) {
-			stream = talloc((TALLOC_CTX *)mpm, struct mpm_stream);
+			stream = talloc_zero((TALLOC_CTX *)mpm, struct mpm_stream);
 			NT_STATUS_HAVE_NO_MEMORY(stream);
+			stream->fd = -1;
 
 			stream->session = mpm_session_init((TALLOC_CTX *)mpm, dce_call);
 			NT_STATUS_HAVE_NO_MEMORY(stream->session);
@@ -644,7 +651,7 @@ static NTSTATUS cache_pull_OpenStream(struct dcesrv_call_state *dce_call,
 			stream->StreamSize = 0;
 			stream->filename = NULL;
 			stream->attachment = attach;
-			stream->cached = false;
+			stream->state = MPM_STREAM_RELAY;
 			stream->message = NULL;
 			stream->ahead = (mpm->ahead == true) ? true : false;
 			gettimeofday(&stream->tv_start, NULL);
@@ -661,8 +668,9 @@ static NTSTATUS cache_pull_OpenStream(struct dcesrv_call_state *dce_call,
 	for (message = mpm->messages; message; message = message->next) {
 		if ((mpm_session_cmp(message->session, dce_call) == true) &&
 		    mapi_request->handles[mapi_req.handle_idx] == message->handle) {
-			stream = talloc((TALLOC_CTX *)mpm, struct mpm_stream);
+			stream = talloc_zero((TALLOC_CTX *)mpm, struct mpm_stream);
 			NT_STATUS_HAVE_NO_MEMORY(stream);
+			stream->fd = -1;
 
 			stream->session = mpm_session_init((TALLOC_CTX *)mpm, dce_call);
 			NT_STATUS_HAVE_NO_MEMORY(stream->session);
@@ -673,7 +681,7 @@ static NTSTATUS cache_pull_OpenStream(struct dcesrv_call_state *dce_call,
 			stream->StreamSize = 0;
 			stream->filename = NULL;
 			stream->attachment = NULL;
-			stream->cached = false;
+			stream->state = MPM_STREAM_RELAY;
 			stream->ahead = (mpm->ahead == true) ? true : false;
 			gettimeofday(&stream->tv_start, NULL);
 			server_id_printable = server_id_str(NULL, &(stream->session->server_id));
@@ -743,7 +751,7 @@ static NTSTATUS cache_push_OpenStream(struct dcesrv_call_state *dce_call,
 						  server_id_printable, el->session->context_id, el->PropertyTag, el->handle,
 						  el->StreamSize);
 					talloc_free(server_id_printable);
-					mpm_cache_ldb_add_stream(mpm, mpm->ldb_ctx, el);
+					mpm_cache_stream_open(mpm, el);
 				} else {
 					server_id_printable = server_id_str(NULL, &(el->session->server_id));
 					OC_DEBUG(0, "* [s(%s),c(0x%x)] Del: Stream OpenStream returned %s",
@@ -760,17 +768,179 @@ static NTSTATUS cache_push_OpenStream(struct dcesrv_call_state *dce_call,
 }
 
 
+/**
+   \details Find the stream registered for a handle of the session
+
+   \param dce_call pointer to the session context
+   \param handle the stream MAPI handle
+
+   \return the mpm_stream entry on success, otherwise NULL
+ */
+static struct mpm_stream *cache_find_stream(struct dcesrv_call_state *dce_call, uint32_t handle)
+{
+	struct mpm_stream	*stream;
+
+	for (stream = mpm->streams; stream; stream = stream->next) {
+		if ((mpm_session_cmp(stream->session, dce_call) == true) &&
+		    handle == stream->handle) {
+			return stream;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Monitor SeekStream requests.
+
+   The position of the remote server in a stream served from the cache
+   or read ahead differs from the client one: a seek relative to the
+   current position is made absolute. The stream is relayed from then
+   on.
+
+   \param dce_call pointer to the session context
+   \param mapi_req pointer to the SeekStream MAPI request
+   \param EcDoRpc pointer to the EcDoRpc operation
+
+   \return NT_STATUS_OK
+ */
+static NTSTATUS cache_pull_SeekStream(struct dcesrv_call_state *dce_call,
+				      struct EcDoRpc_MAPI_REQ *mapi_req,
+				      struct EcDoRpc *EcDoRpc)
+{
+	struct mpm_stream	*stream;
+	struct SeekStream_req	*request;
+
+	stream = cache_find_stream(dce_call, EcDoRpc->in.mapi_request->handles[mapi_req->handle_idx]);
+	if (!stream || stream->state == MPM_STREAM_RELAY) return NT_STATUS_OK;
+
+	request = &mapi_req->u.mapi_SeekStream;
+	if (request->Origin == 0x1) {
+		request->Origin = 0x0;
+		request->Offset += stream->offset;
+	}
+	OC_DEBUG(2, "* Seek in stream %s, relayed from now on", stream->key);
+	mpm_cache_stream_close(stream);
+
+	return NT_STATUS_OK;
+}
+
+
+/**
+   \details Monitor ReadStream requests on streams this session
+   fetches and widen them to read ahead.
+
+   The size the client requested is recorded for the reply. When the
+   request holds this single call, the read is widened to the read
+   ahead window, which starts at the client size and doubles with each
+   sequential read going to the remote server, up to
+   mpm_cache:readahead and the response size the client accepts.
+
+   \param dce_call pointer to the session context
+   \param mapi_req pointer to the ReadStream MAPI request
+   \param EcDoRpc pointer to the EcDoRpc operation
+   \param single whether the ReadStream call is alone in the request
+
+   \return NT_STATUS_OK
+ */
+static NTSTATUS cache_pull_ReadStream(struct dcesrv_call_state *dce_call,
+				      struct EcDoRpc_MAPI_REQ *mapi_req,
+				      struct EcDoRpc *EcDoRpc, bool single)
+{
+	struct mpm_stream	*stream;
+	struct ReadStream_req	*request;
+	uint32_t		requested;
+	uint32_t		limit;
+	uint32_t		window;
+	size_t			needed;
+
+	stream = cache_find_stream(dce_call, EcDoRpc->in.mapi_request->handles[mapi_req->handle_idx]);
+	if (!stream || stream->state != MPM_STREAM_FETCH || stream->ahead == true) {
+		return NT_STATUS_OK;
+	}
+
+	request = &mapi_req->u.mapi_ReadStream;
+	requested = (request->ByteCount == 0xBABE) ? request->MaximumByteCount.value : request->ByteCount;
+	stream->ByteCount = requested;
+
+	/* Served from what was read ahead */
+	needed = stream->offset + MIN(requested, stream->StreamSize - stream->offset);
+	if (needed <= stream->remote_offset) return NT_STATUS_OK;
+
+	if (!mpm->readahead || single == false || EcDoRpc->in.size <= MPM_READAHEAD_SLACK) {
+		return NT_STATUS_OK;
+	}
+
+	limit = MIN(mpm->readahead, EcDoRpc->in.size - MPM_READAHEAD_SLACK);
+	limit = MIN(limit, (request->ByteCount == 0xBABE) ? 0xFFFFFFFF : 0xFFF0);
+	stream->window = stream->window ? MIN(stream->window * 2, limit) : requested;
+
+	window = MAX(stream->window, needed - stream->remote_offset);
+	window = MIN(window, stream->StreamSize - stream->remote_offset);
+	if (window > requested) {
+		OC_DEBUG(5, "* Reading 0x%x bytes ahead of 0x%x in stream %s", window, requested, stream->key);
+		if (request->ByteCount == 0xBABE) {
+			request->MaximumByteCount.value = window;
+		} else {
+			request->ByteCount = window;
+		}
+	}
+
+	return NT_STATUS_OK;
+}
+
+
+/**
+   \details Reply to a widened ReadStream call with the bytes the
+   client requested
+
+   The remote server data has been written to the in-flight file and
+   may be preceded by data read ahead. The reply holds up to the
+   ByteCount the client requested from its position.
+
+   \param EcDoRpc pointer to the current EcDoRpc operation
+   \param mapi_repl pointer to the ReadStream MAPI reply
+   \param stream pointer to the mpm_stream entry
+ */
+static void cache_trim_ReadStream(struct EcDoRpc *EcDoRpc, struct EcDoRpc_MAPI_REPL *mapi_repl,
+				  struct mpm_stream *stream)
+{
+	struct mapi_response	*mapi_response;
+	DATA_BLOB		*data;
+	uint8_t			*buffer;
+	size_t			relayed;
+	size_t			length;
+
+	mapi_response = EcDoRpc->out.mapi_response;
+	data = &mapi_repl->u.mapi_ReadStream.data;
+	relayed = data->length;
+
+	buffer = talloc_size(mapi_response, stream->ByteCount);
+	if (!buffer) return;
+
+	mpm_cache_stream_read(stream, stream->ByteCount, &length, &buffer);
+	data->data = buffer;
+	data->length = length;
+
+	mapi_response->mapi_len = mapi_response->mapi_len - relayed + length;
+	mapi_response->length = mapi_response->length - relayed + length;
+	*EcDoRpc->out.length = mapi_response->mapi_len;
+}
+
+
 /**
    \details Monitor ReadStream replies.
 
    This function writes ReadStream data received from remote server
-   and associated to messages or attachments to the opened associated
-   file. This function only writes data if the file is not already
-   cached, otherwise it just returns.
+   and associated to messages or attachments to the in-flight file of
+   the stream when this session fetches it, and moves the file into
+   the store once complete. Replies built from the cache by the
+   dispatch routine are skipped.
 
    \param dce_call pointer to the session context
    \param mapi_req reference to the ReadStream MAPI request
-   \param mapi_repl reference to the ReadStream MAPI reply
+   \param mapi_repl pointer to the ReadStream MAPI reply
    \param EcDoRpc pointer to the current EcDoRpc operation
 
    \return NT_STATUS_OK
@@ -779,44 +949,62 @@ static NTSTATUS cache_push_OpenStream(struct dcesrv_call_state *dce_call,
  */
 static NTSTATUS cache_push_ReadStream(struct dcesrv_call_state *dce_call,
 				      struct EcDoRpc_MAPI_REQ mapi_req,
-				      struct EcDoRpc_MAPI_REPL mapi_repl, 
+				      struct EcDoRpc_MAPI_REPL *mapi_repl, 
 				      struct EcDoRpc *EcDoRpc)
 {
 	struct mpm_stream	*stream;
 	struct mapi_response	*mapi_response;
 	struct ReadStream_repl	response;
-	/* struct ReadStream_req	request; */
 	char			*server_id_printable = NULL;
+	bool			aligned;
 
 	mapi_response = EcDoRpc->out.mapi_response;
-	response = mapi_repl.u.mapi_ReadStream;
-	/* request = mapi_req.u.mapi_ReadStream; */
+	response = mapi_repl->u.mapi_ReadStream;
 
 	/* Check if the handle is registered */
-	for (stream = mpm->streams; stream; stream = stream->next) {
-		if ((mpm_session_cmp(stream->session, dce_call) == true) &&
-		    mapi_response->handles[mapi_repl.handle_idx] == stream->handle) {
-			if (stream->fp && stream->cached == false) {
-				if (mpm->sync == true && stream->StreamSize > mpm->sync_min) {
-					cache_exec_sync_cmd(stream);
-				} else {
-					server_id_printable = server_id_str(NULL, &(stream->session->server_id));
-					OC_DEBUG(5, "* [s(%s),c(0x%x)] %zd bytes from remove server",
-						  server_id_printable, stream->session->context_id, response.data.length);
-					talloc_free(server_id_printable);
-					mpm_cache_stream_write(stream, response.data.length, response.data.data);
-					if (stream->offset == stream->StreamSize) {
-						if (response.data.length) {
-							cache_dump_stream_stat(stream);
-						}
-					}
-				}
-			} else if (stream->cached == true) {
-				/* This is managed by the dispatch routine */
-			}
-			return NT_STATUS_OK;
+	stream = cache_find_stream(dce_call, mapi_response->handles[mapi_repl->handle_idx]);
+	if (!stream) return NT_STATUS_OK;
+
+	/* This is managed by the dispatch routine */
+	if (stream->local_reply == true) {
+		stream->local_reply = false;
+		return NT_STATUS_OK;
+	}
+
+	switch (stream->state) {
+	case MPM_STREAM_FETCH:
+		aligned = (stream->offset == stream->remote_offset);
+		if (mpm->sync == true && stream->StreamSize > mpm->sync_min && !stream->remote_offset &&
+		    NT_STATUS_IS_OK(cache_exec_sync_cmd(stream))) {
+			stream->offset = stream->remote_offset = response.data.length;
+			break;
+		}
+
+		server_id_printable = server_id_str(NULL, &(stream->session->server_id));
+		OC_DEBUG(5, "* [s(%s),c(0x%x)] %zd bytes from remove server",
+			  server_id_printable, stream->session->context_id, response.data.length);
+		talloc_free(server_id_printable);
+		mpm_cache_stream_write(stream, response.data.length, response.data.data);
+		if (aligned && response.data.length <= stream->ByteCount) {
+			stream->offset = stream->remote_offset;
+		} else {
+			cache_trim_ReadStream(EcDoRpc, mapi_repl, stream);
+		}
+		if (stream->remote_offset == stream->StreamSize && response.data.length) {
+			cache_dump_stream_stat(stream);
+			mpm_cache_stream_commit(mpm, stream, stream->filename);
 		}
+		break;
+	case MPM_STREAM_SHARED:
+	case MPM_STREAM_CACHED:
+		/* Relayed along with other calls */
+		stream->offset += response.data.length;
+		stream->remote_offset += response.data.length;
+		break;
+	case MPM_STREAM_RELAY:
+		break;
 	}
+
 	return NT_STATUS_OK;
 }
 
@@ -867,6 +1055,12 @@ static NTSTATUS cache_pull(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_c
 		case op_MAPI_OpenStream:
 			cache_pull_OpenStream(dce_call, (TALLOC_CTX *)mpm, mapi_req[i], EcDoRpc);
 			break;
+		case op_MAPI_ReadStream:
+			cache_pull_ReadStream(dce_call, &mapi_req[i], EcDoRpc, (i == 0 && !mapi_req[1].opnum));
+			break;
+		case op_MAPI_SeekStream:
+			cache_pull_SeekStream(dce_call, &mapi_req[i], EcDoRpc);
+			break;
 		case op_MAPI_Release:
 			cache_pull_Release(dce_call, EcDoRpc, mapi_req[i].handle_idx);
 			break;
@@ -936,7 +1130,7 @@ static NTSTATUS cache_push(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_c
 		case op_MAPI_ReadStream:
 			index = cache_find_call_request_index(op_MAPI_ReadStream, mapi_req);
 			if (index == -1) break;
-			cache_push_ReadStream(dce_call, mapi_req[index], mapi_repl[i], EcDoRpc);
+			cache_push_ReadStream(dce_call, mapi_req[index], &mapi_repl[i], EcDoRpc);
 			break;
 		default:
 			break;
@@ -947,12 +1141,118 @@ static NTSTATUS cache_push(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_c
 }
 
 
+/**
+   \details Reply to a ReadStream call with data from the cache
+
+   \param mem_ctx the memory context
+   \param EcDoRpc pointer on EcDoRpc operation
+   \param i the index of the ReadStream call
+   \param ByteCount the number of bytes the client requested
+   \param stream pointer to the mpm_stream entry
+   \param mapiproxy pointer to a mapiproxy structure controlling
+   mapiproxy behavior.
+ */
+static void cache_reply_ReadStream(TALLOC_CTX *mem_ctx, struct EcDoRpc *EcDoRpc, uint32_t i,
+				   uint32_t ByteCount, struct mpm_stream *stream,
+				   struct mapiproxy *mapiproxy)
+{
+	struct mapi_request	*mapi_request;
+	struct mapi_response	*mapi_response;
+
+	mapi_request = EcDoRpc->in.mapi_request;
+	mapi_response = EcDoRpc->out.mapi_response;
+
+	mapiproxy->norelay = true;
+	mapiproxy->ahead = false;
+	stream->local_reply = true;
+
+	/* Create a fake ReadStream reply */
+	mapi_response->mapi_repl = talloc_array(mem_ctx, struct EcDoRpc_MAPI_REPL, i + 2);
+	mapi_response->mapi_repl[i].opnum = op_MAPI_ReadStream;
+	mapi_response->mapi_repl[i].handle_idx = mapi_request->mapi_req[i].handle_idx;
+	mapi_response->mapi_repl[i].error_code = MAPI_E_SUCCESS;
+	mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length = 0;
+	mapi_response->mapi_repl[i].u.mapi_ReadStream.data.data = talloc_size(mem_ctx, ByteCount);
+	mpm_cache_stream_read(stream, (size_t) ByteCount, 
+			      &mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length,
+			      &mapi_response->mapi_repl[i].u.mapi_ReadStream.data.data);
+	if (stream->offset == stream->StreamSize) {
+		if (mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length) {
+			cache_dump_stream_stat(stream);
+		}
+	}
+	OC_DEBUG(5, "* %zd bytes read from cache",
+		  mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length);
+	mapi_response->handles = talloc_array(mem_ctx, uint32_t, 1);
+	mapi_response->handles[0] = stream->handle;
+	mapi_response->mapi_len = 0xE + mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length;
+	mapi_response->length = mapi_response->mapi_len - 4;
+	*EcDoRpc->out.length = mapi_response->mapi_len;
+	EcDoRpc->out.size = EcDoRpc->in.size;
+}
+
+
+/**
+   \details Bring the remote server back to the position of a client
+   which read a shared stream from the cache, when the fetch it shared
+   stops
+
+   The ReadStream call is relayed in a loop and the data the client
+   already has is discarded. The stream is relayed afterwards.
+
+   \param EcDoRpc pointer on EcDoRpc operation
+   \param i the index of the ReadStream call
+   \param stream pointer to the mpm_stream entry
+   \param mapiproxy pointer to a mapiproxy structure controlling
+   mapiproxy behavior.
+ */
+static void cache_resync_ReadStream(struct EcDoRpc *EcDoRpc, uint32_t i,
+				    struct mpm_stream *stream,
+				    struct mapiproxy *mapiproxy)
+{
+	struct mapi_response	*mapi_response;
+	DATA_BLOB		*data;
+	size_t			skip;
+
+	/* First pass: relay the call */
+	if (mapiproxy->ahead == false) {
+		mapiproxy->ahead = true;
+		return;
+	}
+
+	mapi_response = EcDoRpc->out.mapi_response;
+	data = &mapi_response->mapi_repl[i].u.mapi_ReadStream.data;
+
+	if (data->length && stream->remote_offset + data->length <= stream->offset) {
+		stream->remote_offset += data->length;
+		return;
+	}
+
+	skip = data->length ? stream->offset - stream->remote_offset : 0;
+	data->data += skip;
+	data->length -= skip;
+	mapi_response->mapi_len -= skip;
+	mapi_response->length -= skip;
+	*EcDoRpc->out.length = mapi_response->mapi_len;
+
+	stream->offset += data->length;
+	stream->remote_offset = stream->offset;
+	OC_DEBUG(2, "* Stream %s relayed from offset 0x%zx", stream->key, stream->offset);
+	mpm_cache_stream_close(stream);
+
+	mapiproxy->norelay = true;
+	mapiproxy->ahead = false;
+	stream->local_reply = true;
+}
+
+
 /**
    \details Dispatch function. 
 
    This function avoids calling dcerpc_ndr_request - understand
    forwarding client request to remove server - when the client is
-   reading a message/attachment stream available in the cache.
+   reading a message/attachment stream available in the cache or
+   being fetched by another session.
 
    This function can also be used to loop over dcerpc_ndr_request and
    perform a read-ahead operation.
@@ -973,6 +1273,9 @@ static NTSTATUS cache_dispatch(struct dcesrv_call_state *dce_call, TALLOC_CTX *m
 	struct mapi_response	*mapi_response;
 	struct EcDoRpc_MAPI_REQ	*mapi_req;
 	struct mpm_stream	*stream;
+	struct ReadStream_req	request;
+	uint32_t		ByteCount;
+	size_t			needed;
 	uint32_t		i;
 	uint32_t		count;
 
@@ -1004,64 +1307,66 @@ static NTSTATUS cache_dispatch(struct dcesrv_call_state *dce_call, TALLOC_CTX *m
 	if (i > count) return NT_STATUS_OK;
 
 	for (i = 0; mapi_req[i].opnum; i++) {
-		switch (mapi_req[i].opnum) {
-		case op_MAPI_ReadStream:
-		{
-			struct ReadStream_req	request;
+		if (mapi_req[i].opnum != op_MAPI_ReadStream) continue;
 
-			request = mapi_req[i].u.mapi_ReadStream;
-			for (stream = mpm->streams; stream; stream = stream->next) {
-				if ((mpm_session_cmp(stream->session, dce_call) == true) &&
-				    (mapi_request->handles[mapi_req[i].handle_idx] == stream->handle)) {
-					if (stream->cached == true) {
-					cached:
-						mapiproxy->norelay = true;
-						mapiproxy->ahead = false;
-						/* Create a fake ReadStream reply */
-						mapi_response->mapi_repl = talloc_array(mem_ctx, struct EcDoRpc_MAPI_REPL, i + 2);
-						mapi_response->mapi_repl[i].opnum = op_MAPI_ReadStream;
-						mapi_response->mapi_repl[i].handle_idx = mapi_req[i].handle_idx;
-						mapi_response->mapi_repl[i].error_code = MAPI_E_SUCCESS;
-						mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length = 0;
-						mapi_response->mapi_repl[i].u.mapi_ReadStream.data.data = talloc_size(mem_ctx, request.ByteCount);
-						mpm_cache_stream_read(stream, (size_t) request.ByteCount, 
-								      &mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length,
-								      &mapi_response->mapi_repl[i].u.mapi_ReadStream.data.data);
-						if (stream->offset == stream->StreamSize) {
-							if (mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length) {
-								cache_dump_stream_stat(stream);
-							}
-						}
-						OC_DEBUG(5, "* %zd bytes read from cache",
-							  mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length);
-						mapi_response->handles = talloc_array(mem_ctx, uint32_t, 1);
-						mapi_response->handles[0] = stream->handle;
-						mapi_response->mapi_len = 0xE + mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length;
-						mapi_response->length = mapi_response->mapi_len - 4;
-						*EcDoRpc->out.length = mapi_response->mapi_len;
-						EcDoRpc->out.size = EcDoRpc->in.size;
-						break;
-					} else if ((stream->cached == false) && (stream->ahead == true)) {
-						if (mapiproxy->ahead == true)  {
-							mpm_cache_stream_write(stream,
-									       mapi_response->mapi_repl[i].u.mapi_ReadStream.data.length,
-									       mapi_response->mapi_repl[i].u.mapi_ReadStream.data.data);
-							/* When read ahead is over */
-							if (stream->offset == stream->StreamSize) {
-								cache_dump_stream_stat(stream);
-								mpm_cache_stream_reset(stream);
-								stream->cached = true;
-								stream->ahead = false;
-								goto cached;
-							}
-						} else {
-							mapiproxy->ahead = true;
-						}
-					}
+		stream = cache_find_stream(dce_call, mapi_request->handles[mapi_req[i].handle_idx]);
+		if (!stream) continue;
+
+		request = mapi_req[i].u.mapi_ReadStream;
+		ByteCount = (request.ByteCount == 0xBABE) ? request.MaximumByteCount.value : request.ByteCount;
+
+		switch (stream->state) {
+		case MPM_STREAM_CACHED:
+			cache_reply_ReadStream(mem_ctx, EcDoRpc, i, ByteCount, stream, mapiproxy);
+			break;
+		case MPM_STREAM_SHARED:
+			if (mapiproxy->ahead == true) {
+				cache_resync_ReadStream(EcDoRpc, i, stream, mapiproxy);
+				break;
+			}
+			needed = stream->offset + MIN(ByteCount, stream->StreamSize - stream->offset);
+			if (mpm_cache_stream_wait(mpm, stream, needed)) {
+				cache_reply_ReadStream(mem_ctx, EcDoRpc, i, ByteCount, stream, mapiproxy);
+			} else if (stream->offset == stream->remote_offset) {
+				/* Nothing served from the cache yet */
+				mpm_cache_stream_close(stream);
+			} else {
+				cache_resync_ReadStream(EcDoRpc, i, stream, mapiproxy);
+			}
+			break;
+		case MPM_STREAM_FETCH:
+			if (stream->ahead == false) {
+				/* Served from what was read ahead */
+				needed = stream->offset + MIN(stream->ByteCount, stream->StreamSize - stream->offset);
+				if (stream->offset < stream->remote_offset && needed <= stream->remote_offset) {
+					cache_reply_ReadStream(mem_ctx, EcDoRpc, i, stream->ByteCount, stream, mapiproxy);
 				}
+				break;
 			}
-		}
-		break;
+			if (mapiproxy->ahead == true) {
+				DATA_BLOB	*data;
+
+				data = &mapi_response->mapi_repl[i].u.mapi_ReadStream.data;
+				mpm_cache_stream_write(stream, data->length, data->data);
+				/* When read ahead is over */
+				if (stream->remote_offset == stream->StreamSize) {
+					cache_dump_stream_stat(stream);
+					mpm_cache_stream_commit(mpm, stream, stream->filename);
+				} else if (data->length) {
+					break;
+				} else {
+					OC_DEBUG(0, "* Read ahead of %s stopped at 0x%zx", stream->key, stream->remote_offset);
+					mpm_cache_stream_commit(mpm, stream, stream->filename);
+				}
+				stream->ahead = false;
+				mpm_cache_stream_reset(stream);
+				cache_reply_ReadStream(mem_ctx, EcDoRpc, i, ByteCount, stream, mapiproxy);
+			} else {
+				mapiproxy->ahead = true;
+			}
+			break;
+		case MPM_STREAM_RELAY:
+			break;
 		}
 	}
 
@@ -1124,7 +1429,6 @@ static NTSTATUS cache_unbind(struct server_id server_id, uint32_t context_id)
 			talloc_free(server_id_printable);
 			mpm_session_release(stream->session);
 			mpm_cache_stream_close(stream);
-			talloc_free(stream->filename);
 			DLIST_REMOVE(mpm->streams, stream);
 			talloc_free(stream);
 			stream = mpm->streams;
@@ -1142,7 +1446,14 @@ static NTSTATUS cache_unbind(struct server_id server_id, uint32_t context_id)
    smb.conf
 
    Possible smb.conf parameters:
-	* mpm_cache:database
+	* mpm_cache:path
+	* mpm_cache:max_size
+	* mpm_cache:coalesce_wait
+	* mpm_cache:readahead
+	* mpm_cache:ahead
+	* mpm_cache:sync
+	* mpm_cache:sync_min
+	* mpm_cache:sync_cmd
 
    \param dce_ctx the session context
 
@@ -1151,7 +1462,6 @@ static NTSTATUS cache_unbind(struct server_id server_id, uint32_t context_id)
  */
 static NTSTATUS cache_init(struct dcesrv_context *dce_ctx)
 {
-	char			*database;
 	NTSTATUS		status;
 	struct loadparm_context	*lp_ctx;
 
@@ -1166,6 +1476,9 @@ static NTSTATUS cache_init(struct dcesrv_context *dce_ctx)
 	mpm->sync_min = lpcfg_parm_int(dce_ctx->lp_ctx, NULL, MPM_NAME, "sync_min", 500000);
 	mpm->sync_cmd = str_list_make(dce_ctx, lpcfg_parm_string(dce_ctx->lp_ctx, NULL, MPM_NAME, "sync_cmd"), " ");
 	mpm->dbpath = lpcfg_parm_string(dce_ctx->lp_ctx, NULL, MPM_NAME, "path");
+	mpm->max_size = (uint64_t)lpcfg_parm_int(dce_ctx->lp_ctx, NULL, MPM_NAME, "max_size", 1024) << 20;
+	mpm->coalesce_wait = lpcfg_parm_int(dce_ctx->lp_ctx, NULL, MPM_NAME, "coalesce_wait", 2000);
+	mpm->readahead = lpcfg_parm_int(dce_ctx->lp_ctx, NULL, MPM_NAME, "readahead", 32768);
 
 	if ((mpm->ahead == true) && mpm->sync) {
 		OC_DEBUG(0, "%s: cache:ahead and cache:sync are exclusive!", MPM_ERROR);
@@ -1179,20 +1492,16 @@ static NTSTATUS cache_init(struct dcesrv_context *dce_ctx)
 		return NT_STATUS_INVALID_PARAMETER;
 	}
 
-	database = talloc_asprintf(dce_ctx->lp_ctx, "tdb://%s/%s", mpm->dbpath, MPM_DB);
-	status = mpm_cache_ldb_createdb(dce_ctx, database, &mpm->ldb_ctx);
+	status = mpm_cache_store_init(mpm);
 	if (!NT_STATUS_IS_OK(status)) {
-		talloc_free(database);
 		talloc_free(mpm);
-		return NT_STATUS_NO_MEMORY;
+		return status;
 	}
 
 	lp_ctx = loadparm_init(dce_ctx);
 	lpcfg_load_default(lp_ctx);
 	dcerpc_init();
 
-	talloc_free(database);
-
 	return NT_STATUS_OK;
 }
 
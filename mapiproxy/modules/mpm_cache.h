@@ -24,9 +24,6 @@
 
 #include <stdio.h>
 
-#include <ldb_errors.h>
-#include <ldb.h>
-
 #ifndef	__BEGIN_DECLS
 #ifdef	__cplusplus
 #define	__BEGIN_DECLS		extern "C" {
@@ -56,8 +53,24 @@ struct mpm_attachment {
 	struct mpm_attachment	*next;
 };
 
+/**
+   Where the data of a stream comes from
+ */
+enum mpm_stream_state {
+	MPM_STREAM_RELAY,	/* Not cached, ReadStream calls are relayed */
+	MPM_STREAM_FETCH,	/* Relayed and written to our in-flight file */
+	MPM_STREAM_SHARED,	/* Read from the in-flight file of another session */
+	MPM_STREAM_CACHED	/* Read from the mapped content file */
+};
+
 /**
    A stream can either be for a message or attachment
+
+   offset is the position of the client in the stream and
+   remote_offset the one of the remote server, they only differ when
+   data was served from the cache or read ahead. window is the size
+   of the next read ahead and ByteCount the size the client requested
+   when its ReadStream call was widened.
  */
 struct mpm_stream {
 	struct mpm_session	*session;
@@ -66,9 +79,15 @@ struct mpm_stream {
 	enum MAPITAGS		PropertyTag;
 	uint32_t		StreamSize;
 	size_t			offset;
-	FILE			*fp;
+	size_t			remote_offset;
+	uint32_t		window;
+	uint32_t		ByteCount;
+	enum mpm_stream_state	state;
+	int			fd;
+	uint8_t			*map;
+	char			*key;
 	char			*filename;
-	bool			cached;
+	bool			local_reply;
 	bool			ahead;
 	struct timeval		tv_start;
 	struct mpm_attachment	*attachment;
@@ -80,7 +99,6 @@ struct mpm_stream {
 /* TODO: Make use of dce_ctx->context->context_id to differentiate sessions ? */
 
 struct mpm_cache {
-	struct ldb_context	*ldb_ctx;
 	struct mpm_message	*messages;
 	struct mpm_attachment	*attachments;
 	struct mpm_stream	*streams;
@@ -89,21 +107,25 @@ struct mpm_cache {
 	bool			sync;
 	int			sync_min;
 	char     		**sync_cmd;
+	uint64_t		max_size;
+	uint64_t		size;
+	int			coalesce_wait;
+	uint32_t		readahead;
 };
 
 __BEGIN_DECLS
 
 NTSTATUS       	samba_init_module(void);
 
-NTSTATUS	mpm_cache_ldb_createdb(struct dcesrv_context *, const char *, struct ldb_context **);
-NTSTATUS	mpm_cache_ldb_add_message(TALLOC_CTX *, struct ldb_context *, struct mpm_message *);
-NTSTATUS	mpm_cache_ldb_add_attachment(TALLOC_CTX *, struct ldb_context *, struct mpm_attachment *);
-NTSTATUS	mpm_cache_ldb_add_stream(struct mpm_cache *, struct ldb_context *, struct mpm_stream *);
+NTSTATUS	mpm_cache_store_init(struct mpm_cache *);
+NTSTATUS	mpm_cache_store_evict(struct mpm_cache *);
 
 NTSTATUS	mpm_cache_stream_open(struct mpm_cache *, struct mpm_stream *);
 NTSTATUS	mpm_cache_stream_close(struct mpm_stream *);
 NTSTATUS	mpm_cache_stream_write(struct mpm_stream *, uint16_t, uint8_t *);
 NTSTATUS	mpm_cache_stream_read(struct mpm_stream *, size_t, size_t *, uint8_t **);
+NTSTATUS	mpm_cache_stream_commit(struct mpm_cache *, struct mpm_stream *, const char *);
+bool		mpm_cache_stream_wait(struct mpm_cache *, struct mpm_stream *, size_t);
 NTSTATUS	mpm_cache_stream_reset(struct mpm_stream *);
 
 __END_DECLS
@@ -114,8 +136,12 @@ __END_DECLS
 
 #define	MPM_NAME	"mpm_cache"
 #define	MPM_ERROR	"[ERROR] mpm_cache:"
-#define	MPM_DB		"mpm_cache.ldb"
 #define	MPM_DB_STORAGE	"data"
+#define	MPM_DB_KEYS	"keys"
+#define	MPM_DB_INFLIGHT	"inflight"
+
+/* Room kept in the EcDoRpc response for everything but ReadStream data */
+#define	MPM_READAHEAD_SLACK	0x100
 
 #define	MPM_SESSION(x)	x->session->server_id.pid, x->session->server_id.task_id, x->session->server_id.vnn, x->session->context_id
 
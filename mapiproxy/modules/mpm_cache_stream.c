@@ -23,101 +23,484 @@
    \file mpm_cache_stream.c
 
    \brief Storage routines for the cache module
+
+   Stream data is stored once per content under
+   MPM_DB_STORAGE/xx/<hash>-<size>, where the name is a stable 64 bit
+   hash of the bytes and their length. Each message or attachment
+   stream is a symbolic link under MPM_DB_KEYS, named after the
+   folder, message, attachment and property tag, pointing to its
+   content: identical attachments downloaded through different
+   messages are stored once.
+
+   A stream being downloaded is written to MPM_DB_INFLIGHT/<key>,
+   created exclusively and locked by the session fetching it. Other
+   sessions opening the same stream meanwhile read that file instead
+   of fetching the stream again.
+
+   The modification time of the content files is updated on every
+   hit and the least recently used ones are removed when the store
+   exceeds mpm_cache:max_size.
  */
 
 #include "mapiproxy/dcesrv_mapiproxy.h"
 #include "mapiproxy/libmapiproxy/libmapiproxy.h"
 #include "mapiproxy/modules/mpm_cache.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
 #include "libmapi/libmapi.h"
 #include "libmapi/libmapi_private.h"
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/file.h>
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+
+/* Interval between two checks of an in-flight file, in microseconds */
+#define	MPM_CACHE_WAIT_STEP	10000
+
+struct mpm_cache_entry {
+	char		*path;
+	time_t		mtime;
+	uint64_t	size;
+};
+
+
+/**
+   \details Build the name identifying a stream in the store
+
+   \param mem_ctx pointer to the memory context
+   \param stream pointer to the mpm_stream entry
+
+   \return Allocated name on success, otherwise NULL
+ */
+static char *mpm_cache_stream_key(TALLOC_CTX *mem_ctx, struct mpm_stream *stream)
+{
+	if (stream->attachment && stream->attachment->message) {
+		return talloc_asprintf(mem_ctx, "0x%"PRIx64"-0x%"PRIx64"-%d-0x%x",
+				       stream->attachment->message->FolderId,
+				       stream->attachment->message->MessageId,
+				       stream->attachment->AttachmentID,
+				       stream->PropertyTag);
+	}
+
+	if (stream->message) {
+		return talloc_asprintf(mem_ctx, "0x%"PRIx64"-0x%"PRIx64"-0x%x",
+				       stream->message->FolderId,
+				       stream->message->MessageId,
+				       stream->PropertyTag);
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Map a content file opened on stream->fd
+
+   \param stream pointer to the mpm_stream entry
+
+   \return true if the file matches the stream size and is mapped,
+   otherwise false
+ */
+static bool mpm_cache_stream_map(struct mpm_stream *stream)
+{
+	struct stat	sb;
+	void		*addr;
+
+	if (fstat(stream->fd, &sb) == -1) return false;
+	if (sb.st_size != stream->StreamSize) {
+		OC_DEBUG(1, "* Cached stream %s is 0x%x bytes, 0x%x expected",
+			  stream->key, (uint32_t)sb.st_size, stream->StreamSize);
+		return false;
+	}
+
+	stream->map = NULL;
+	if (!stream->StreamSize) return true;
+
+	addr = mmap(NULL, stream->StreamSize, PROT_READ, MAP_SHARED, stream->fd, 0);
+	if (addr == MAP_FAILED) {
+		OC_DEBUG(0, "* Unable to map %s: %s", stream->key, strerror(errno));
+		return false;
+	}
+	stream->map = (uint8_t *) addr;
+
+	return true;
+}
+
+
+static void mpm_cache_stream_unmap(struct mpm_stream *stream)
+{
+	if (stream->map) {
+		munmap(stream->map, stream->StreamSize);
+		stream->map = NULL;
+	}
+}
+
+
+/**
+   \details Check whether the writer of an in-flight file is still
+   fetching it
+
+   \param fd file descriptor opened on the in-flight file
+
+   \return true if the file is locked by its writer, otherwise false
+ */
+static bool mpm_cache_inflight_locked(int fd)
+{
+	if (flock(fd, LOCK_SH|LOCK_NB) == -1) {
+		return (errno == EWOULDBLOCK);
+	}
+	flock(fd, LOCK_UN);
+
+	return false;
+}
+
 
 /**
-   \details Create a file: message or attachment in the cache
+   \details Remove the in-flight file of a stream if it is still the
+   one the stream writes to
 
-   If the stream is attached to an attachment:	FolderID/MessageID/AttachmentID.stream
-   If the stream is attached to a message:	FolderID/MessageID.stream
+   \param stream pointer to the mpm_stream entry
+ */
+static void mpm_cache_inflight_unlink(struct mpm_stream *stream)
+{
+	struct stat	sb_fd;
+	struct stat	sb_path;
+
+	if (stream->fd == -1 || !stream->filename) return;
+	if (fstat(stream->fd, &sb_fd) == -1) return;
+	if (stat(stream->filename, &sb_path) == -1) return;
+
+	if (sb_fd.st_dev == sb_path.st_dev && sb_fd.st_ino == sb_path.st_ino) {
+		unlink(stream->filename);
+	}
+}
+
+
+static int mpm_cache_entry_cmp(const void *a, const void *b)
+{
+	const struct mpm_cache_entry	*ea = (const struct mpm_cache_entry *) a;
+	const struct mpm_cache_entry	*eb = (const struct mpm_cache_entry *) b;
+
+	if (ea->mtime < eb->mtime) return -1;
+	if (ea->mtime > eb->mtime) return 1;
+	return 0;
+}
+
+
+/**
+   \details List the content files of the store
+
+   \param mem_ctx pointer to the memory context
+   \param mpm pointer to the cache module general structure
+   \param entries pointer on the array of entries to return
+   \param count pointer on the number of entries to return
+
+   \return the total size of the content files in bytes
+ */
+static uint64_t mpm_cache_store_scan(TALLOC_CTX *mem_ctx, struct mpm_cache *mpm,
+				     struct mpm_cache_entry **entries, uint32_t *count)
+{
+	struct mpm_cache_entry	*list = NULL;
+	DIR			*top;
+	DIR			*sub;
+	struct dirent		*de;
+	struct dirent		*fe;
+	struct stat		sb;
+	char			*dir;
+	char			*path;
+	uint64_t		total = 0;
+	uint32_t		n = 0;
+
+	dir = talloc_asprintf(mem_ctx, "%s/%s", mpm->dbpath, MPM_DB_STORAGE);
+	top = opendir(dir);
+	if (!top) {
+		talloc_free(dir);
+		goto end;
+	}
+
+	while ((de = readdir(top)) != NULL) {
+		if (de->d_name[0] == '.') continue;
+
+		path = talloc_asprintf(mem_ctx, "%s/%s", dir, de->d_name);
+		sub = opendir(path);
+		if (!sub) {
+			talloc_free(path);
+			continue;
+		}
+
+		while ((fe = readdir(sub)) != NULL) {
+			if (fe->d_name[0] == '.') continue;
+
+			list = talloc_realloc(mem_ctx, list, struct mpm_cache_entry, n + 1);
+			list[n].path = talloc_asprintf(list, "%s/%s", path, fe->d_name);
+			if (stat(list[n].path, &sb) == -1 || !S_ISREG(sb.st_mode)) {
+				talloc_free(list[n].path);
+				continue;
+			}
+			list[n].mtime = sb.st_mtime;
+			list[n].size = sb.st_size;
+			total += sb.st_size;
+			n++;
+		}
+		closedir(sub);
+		talloc_free(path);
+	}
+	closedir(top);
+	talloc_free(dir);
+
+end:
+	if (entries) {
+		*entries = list;
+	} else {
+		talloc_free(list);
+	}
+	if (count) *count = n;
+
+	return total;
+}
+
+
+/**
+   \details Remove the links of the store whose content was evicted
+
+   \param mem_ctx pointer to the memory context
+   \param mpm pointer to the cache module general structure
+ */
+static void mpm_cache_store_sweep_keys(TALLOC_CTX *mem_ctx, struct mpm_cache *mpm)
+{
+	DIR		*keys;
+	struct dirent	*de;
+	struct stat	sb;
+	char		*dir;
+	char		*path;
+
+	dir = talloc_asprintf(mem_ctx, "%s/%s", mpm->dbpath, MPM_DB_KEYS);
+	keys = opendir(dir);
+	if (!keys) {
+		talloc_free(dir);
+		return;
+	}
+
+	while ((de = readdir(keys)) != NULL) {
+		if (de->d_name[0] == '.') continue;
+
+		path = talloc_asprintf(mem_ctx, "%s/%s", dir, de->d_name);
+		if (stat(path, &sb) == -1 && errno == ENOENT) {
+			unlink(path);
+		}
+		talloc_free(path);
+	}
+	closedir(keys);
+	talloc_free(dir);
+}
+
+
+/**
+   \details Remove the least recently used content files until the
+   store is back under 90% of mpm_cache:max_size
+
+   The store is shared by every mapiproxy process, the size computed
+   by the scan replaces the per-process estimate.
+
+   \param mpm pointer to the cache module general structure
+
+   \return NT_STATUS_OK
+ */
+NTSTATUS mpm_cache_store_evict(struct mpm_cache *mpm)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct mpm_cache_entry	*entries;
+	uint32_t		count;
+	uint32_t		evicted = 0;
+	uint64_t		total;
+	uint64_t		target;
+	uint32_t		i;
+
+	if (!mpm->max_size) return NT_STATUS_OK;
+
+	mem_ctx = talloc_new(NULL);
+	NT_STATUS_HAVE_NO_MEMORY(mem_ctx);
+
+	total = mpm_cache_store_scan(mem_ctx, mpm, &entries, &count);
+	if (total > mpm->max_size) {
+		target = mpm->max_size - mpm->max_size / 10;
+		qsort(entries, count, sizeof (struct mpm_cache_entry), mpm_cache_entry_cmp);
+		for (i = 0; i < count && total > target; i++) {
+			if (unlink(entries[i].path) == 0) {
+				total -= entries[i].size;
+				evicted++;
+			}
+		}
+		mpm_cache_store_sweep_keys(mem_ctx, mpm);
+		OC_DEBUG(2, "* Evicted %d cached streams, %"PRIu64" bytes left", evicted, total);
+	}
+	mpm->size = total;
+
+	talloc_free(mem_ctx);
+
+	return NT_STATUS_OK;
+}
+
+
+/**
+   \details Create the store directories, compute the size of the store
+   and remove in-flight files abandoned by a previous instance
+
+   \param mpm pointer to the cache module general structure
+
+   \return NT_STATUS_OK on success, otherwise NT_STATUS_UNSUCCESSFUL
+ */
+NTSTATUS mpm_cache_store_init(struct mpm_cache *mpm)
+{
+	TALLOC_CTX	*mem_ctx;
+	const char	*dirs[] = { "", MPM_DB_STORAGE, MPM_DB_KEYS, MPM_DB_INFLIGHT, NULL };
+	DIR		*inflight;
+	struct dirent	*de;
+	char		*path;
+	int		fd;
+	uint32_t	i;
+
+	mem_ctx = talloc_new(NULL);
+	NT_STATUS_HAVE_NO_MEMORY(mem_ctx);
+
+	for (i = 0; dirs[i]; i++) {
+		path = talloc_asprintf(mem_ctx, "%s/%s", mpm->dbpath, dirs[i]);
+		if (mkdir(path, 0777) == -1 && errno != EEXIST) {
+			OC_DEBUG(0, "%s: Unable to create %s: %s", MPM_ERROR, path, strerror(errno));
+			talloc_free(mem_ctx);
+			return NT_STATUS_UNSUCCESSFUL;
+		}
+		talloc_free(path);
+	}
+
+	path = talloc_asprintf(mem_ctx, "%s/%s", mpm->dbpath, MPM_DB_INFLIGHT);
+	inflight = opendir(path);
+	if (inflight) {
+		while ((de = readdir(inflight)) != NULL) {
+			char	*file;
+
+			if (de->d_name[0] == '.') continue;
+			file = talloc_asprintf(mem_ctx, "%s/%s", path, de->d_name);
+			fd = open(file, O_RDONLY);
+			if (fd != -1) {
+				if (!mpm_cache_inflight_locked(fd)) {
+					unlink(file);
+				}
+				close(fd);
+			}
+			talloc_free(file);
+		}
+		closedir(inflight);
+	}
+	talloc_free(mem_ctx);
+
+	mpm->size = mpm_cache_store_scan(NULL, mpm, NULL, NULL);
+	OC_DEBUG(2, "* Cache store %s holds %"PRIu64" bytes", mpm->dbpath, mpm->size);
+	if (mpm->max_size && mpm->size > mpm->max_size) {
+		return mpm_cache_store_evict(mpm);
+	}
+
+	return NT_STATUS_OK;
+}
+
+
+/**
+   \details Open the cache for a message or attachment stream
+
+   The stream is either served from the store, shared with the
+   session currently fetching it or fetched by this session into a
+   new in-flight file. Streams which cannot be cached are relayed.
 
    \param mpm pointer to the cache module general structure
    \param stream pointer to the mpm_stream entry
 
-   \return Return a FILE pointer otherwise NULL
+   \return NT_STATUS_OK
  */
 NTSTATUS mpm_cache_stream_open(struct mpm_cache *mpm, struct mpm_stream *stream)
 {
 	TALLOC_CTX	*mem_ctx;
 	char		*file;
-	int		ret;
+	uint32_t	retry;
 
 	mem_ctx = (TALLOC_CTX *) mpm;
 
-	if (stream->filename) {
-		stream->fp = fopen(stream->filename, "r");
-		stream->offset = 0;
-		return NT_STATUS_OK;
+	stream->state = MPM_STREAM_RELAY;
+	stream->fd = -1;
+	stream->map = NULL;
+	stream->offset = 0;
+	stream->remote_offset = 0;
+
+	stream->key = mpm_cache_stream_key(mem_ctx, stream);
+	if (!stream->key) return NT_STATUS_OK;
+
+	/* Step 1. Look for the stream in the store */
+	file = talloc_asprintf(mem_ctx, "%s/%s/%s", mpm->dbpath, MPM_DB_KEYS, stream->key);
+	stream->fd = open(file, O_RDONLY);
+	if (stream->fd != -1) {
+		if (mpm_cache_stream_map(stream)) {
+			OC_DEBUG(2, "* Loading from cache %s", stream->key);
+			/* Keep track of the last use for the eviction */
+			futimens(stream->fd, NULL);
+			stream->filename = file;
+			stream->state = MPM_STREAM_CACHED;
+			stream->ahead = false;
+			return NT_STATUS_OK;
+		}
+		close(stream->fd);
+		stream->fd = -1;
+		unlink(file);
+	} else if (errno == ENOENT) {
+		/* Remove the link if its content was evicted */
+		unlink(file);
 	}
-
-	if (stream->message) {
-		/* Create the folder */
-		file = talloc_asprintf(mem_ctx, "%s/0x%"PRIx64, mpm->dbpath, stream->message->FolderId);
-		ret = mkdir(file, 0777);
-		talloc_free(file);
-		if ((ret == -1) && (errno != EEXIST)) return NT_STATUS_UNSUCCESSFUL;
-
-		/* Open the file */
-		file = talloc_asprintf(mem_ctx, "%s/0x%"PRIx64"/0x%"PRIx64".stream",
-				       mpm->dbpath, stream->message->FolderId,
-				       stream->message->MessageId);
-
-		OC_DEBUG(2, "* Opening Message stream %s", file);
-		stream->filename = talloc_strdup(mem_ctx, file);
-		stream->fp = fopen(file, "w+");
-		stream->offset = 0;
-		talloc_free(file);
-		
-		return NT_STATUS_OK;
-	}
-
-	if (stream->attachment) {
-		/* Create the folders */
-		file = talloc_asprintf(mem_ctx, "%s/0x%"PRIx64, mpm->dbpath, 
-				       stream->attachment->message->FolderId);
-		ret = mkdir(file, 0777);
-		talloc_free(file);
-		if ((ret == -1) && (errno != EEXIST)) return NT_STATUS_UNSUCCESSFUL;
-
-		file = talloc_asprintf(mem_ctx, "%s/0x%"PRIx64"/0x%"PRIx64, mpm->dbpath,
-				       stream->attachment->message->FolderId, 
-				       stream->attachment->message->MessageId);
-		ret = mkdir(file, 0777);
-		talloc_free(file);
-		if ((ret == -1) && (errno != EEXIST)) return NT_STATUS_UNSUCCESSFUL;
-
-		file = talloc_asprintf(mem_ctx, "%s/0x%"PRIx64"/0x%"PRIx64"/%d.stream", 
-				       mpm->dbpath,
-				       stream->attachment->message->FolderId, 
-				       stream->attachment->message->MessageId,
-				       stream->attachment->AttachmentID);
-
-		OC_DEBUG(2, "* Opening Attachment stream %s", file);
-		stream->filename = talloc_strdup(mem_ctx, file);
-		stream->fp = fopen(file, "w+");
-		stream->offset = 0;
-		talloc_free(file);
-
-		return NT_STATUS_OK;
+	talloc_free(file);
+
+	/* Step 2. Fetch it or share the fetch in progress */
+	file = talloc_asprintf(mem_ctx, "%s/%s/%s", mpm->dbpath, MPM_DB_INFLIGHT, stream->key);
+	for (retry = 0; retry < 2; retry++) {
+		stream->fd = open(file, O_RDWR|O_CREAT|O_EXCL, 0644);
+		if (stream->fd != -1) {
+			flock(stream->fd, LOCK_EX|LOCK_NB);
+			OC_DEBUG(2, "* Fetching stream %s", stream->key);
+			stream->filename = file;
+			stream->state = MPM_STREAM_FETCH;
+			return NT_STATUS_OK;
+		}
+		if (errno != EEXIST) break;
+
+		stream->fd = open(file, O_RDONLY);
+		if (stream->fd == -1) continue;
+
+		if (mpm_cache_inflight_locked(stream->fd)) {
+			OC_DEBUG(2, "* Sharing stream %s being fetched", stream->key);
+			stream->filename = file;
+			stream->state = MPM_STREAM_SHARED;
+			stream->ahead = false;
+			return NT_STATUS_OK;
+		}
+
+		/* The session fetching it is gone */
+		close(stream->fd);
+		stream->fd = -1;
+		unlink(file);
 	}
 
+	OC_DEBUG(1, "* Unable to cache stream %s: %s", stream->key, strerror(errno));
+	talloc_free(file);
+	stream->ahead = false;
+
 	return NT_STATUS_OK;
 }
 
 
 /**
-   \details Close the filesystem stream
+   \details Close the cache of a stream
+
+   An in-flight file whose fetch did not complete is removed.
 
    \param stream pointer to the mpm_stream entry
 
@@ -125,13 +508,23 @@ NTSTATUS mpm_cache_stream_open(struct mpm_cache *mpm, struct mpm_stream *stream)
  */
 NTSTATUS mpm_cache_stream_close(struct mpm_stream *stream)
 {
-	if (stream && stream->fp) {
-		fclose(stream->fp);
-		stream->fp = NULL;
-	} else {
+	if (!stream || stream->fd == -1) {
 		return NT_STATUS_NOT_FOUND;
 	}
 
+	if (stream->state == MPM_STREAM_FETCH) {
+		mpm_cache_inflight_unlink(stream);
+	}
+	mpm_cache_stream_unmap(stream);
+	close(stream->fd);
+	stream->fd = -1;
+	stream->state = MPM_STREAM_RELAY;
+
+	talloc_free(stream->filename);
+	stream->filename = NULL;
+	talloc_free(stream->key);
+	stream->key = NULL;
+
 	return NT_STATUS_OK;
 }
 
@@ -149,8 +542,23 @@ NTSTATUS mpm_cache_stream_close(struct mpm_stream *stream)
  */
 NTSTATUS mpm_cache_stream_read(struct mpm_stream *stream, size_t input_size, size_t *length, uint8_t **data)
 {
-	fseek(stream->fp, stream->offset, SEEK_SET);
-	*length = fread(*data, sizeof (uint8_t), input_size, stream->fp);
+	ssize_t		ret;
+
+	*length = 0;
+	if (stream->offset >= stream->StreamSize) return NT_STATUS_OK;
+
+	if (input_size > stream->StreamSize - stream->offset) {
+		input_size = stream->StreamSize - stream->offset;
+	}
+
+	if (stream->map) {
+		memcpy(*data, stream->map + stream->offset, input_size);
+		*length = input_size;
+	} else if (stream->fd != -1) {
+		ret = pread(stream->fd, *data, input_size, stream->offset);
+		*length = (ret > 0) ? ret : 0;
+	}
+
 	stream->offset += *length;
 	OC_DEBUG(5, "* Current offset: 0x%zx", stream->offset);
 
@@ -159,7 +567,51 @@ NTSTATUS mpm_cache_stream_read(struct mpm_stream *stream, size_t input_size, siz
 
 
 /**
-   \details Write length bytes to a local stream
+   \details Wait for the session fetching a shared stream to provide
+   the bytes a read needs
+
+   Waiting is bounded by mpm_cache:coalesce_wait. It is pointless when
+   the writer is gone or lives in this process, since it cannot make
+   progress while we wait.
+
+   \param mpm pointer to the cache module general structure
+   \param stream pointer to the shared mpm_stream entry
+   \param needed the stream size the read needs
+
+   \return true if the bytes are available, otherwise false
+ */
+bool mpm_cache_stream_wait(struct mpm_cache *mpm, struct mpm_stream *stream, size_t needed)
+{
+	struct mpm_stream	*el;
+	struct stat		sb;
+	int			waited = 0;
+
+	if (stream->state != MPM_STREAM_SHARED) return false;
+
+	for (el = mpm->streams; el; el = el->next) {
+		if (el != stream && el->state == MPM_STREAM_FETCH &&
+		    el->key && !strcmp(el->key, stream->key)) {
+			return (fstat(stream->fd, &sb) == 0 && (size_t)sb.st_size >= needed);
+		}
+	}
+
+	while (true) {
+		if (fstat(stream->fd, &sb) == -1) return false;
+		if ((size_t)sb.st_size >= needed) return true;
+		if (!mpm_cache_inflight_locked(stream->fd)) {
+			/* The writer may have completed in between */
+			return (fstat(stream->fd, &sb) == 0 && (size_t)sb.st_size >= needed);
+		}
+		if (waited >= mpm->coalesce_wait * 1000) return false;
+		usleep(MPM_CACHE_WAIT_STEP);
+		waited += MPM_CACHE_WAIT_STEP;
+	}
+}
+
+
+/**
+   \details Write length bytes received from the remote server to the
+   in-flight file of a stream
 
    \param stream pointer to the mpm_stream entry
    \param length the data length to write to the stream
@@ -169,21 +621,165 @@ NTSTATUS mpm_cache_stream_read(struct mpm_stream *stream, size_t input_size, siz
  */
 NTSTATUS mpm_cache_stream_write(struct mpm_stream *stream, uint16_t length, uint8_t *data)
 {
-	uint32_t	WrittenSize;
+	ssize_t		WrittenSize;
 
-	fseek(stream->fp, stream->offset, SEEK_SET);
-	WrittenSize = fwrite(data, sizeof (uint8_t), length, stream->fp);
+	if (stream->state != MPM_STREAM_FETCH) return NT_STATUS_UNSUCCESSFUL;
+
+	WrittenSize = pwrite(stream->fd, data, length, stream->remote_offset);
 	if (WrittenSize != length) {
 		OC_DEBUG(0, "* WrittenSize != length");
 		return NT_STATUS_UNSUCCESSFUL;
 	}
 
-	stream->offset += WrittenSize;
+	stream->remote_offset += WrittenSize;
 
 	return NT_STATUS_OK;
 }
 
 
+/**
+   \details Move a complete stream file into the store
+
+   The file is renamed after its content, or dropped if the store
+   already holds the same content, and the stream key is linked to
+   it. The stream is then served from the mapped content. If the
+   content cannot be stored the stream keeps reading the data it
+   already has.
+
+   \param mpm pointer to the cache module general structure
+   \param stream pointer to the mpm_stream entry
+   \param path the complete stream file
+
+   \return NT_STATUS_OK on success, otherwise NT_STATUS_UNSUCCESSFUL
+ */
+NTSTATUS mpm_cache_stream_commit(struct mpm_cache *mpm, struct mpm_stream *stream, const char *path)
+{
+	TALLOC_CTX	*mem_ctx;
+	struct stat	sb;
+	struct stat	sb_fd;
+	uint8_t		*data = NULL;
+	uint8_t		*other = NULL;
+	uint64_t	hash;
+	char		*name;
+	char		*content;
+	char		*link;
+	char		*tmp;
+	int		fd = -1;
+	int		fd_content;
+	bool		owned;
+
+	mem_ctx = talloc_new(NULL);
+	NT_STATUS_HAVE_NO_MEMORY(mem_ctx);
+
+	owned = (stream->state == MPM_STREAM_FETCH && !strcmp(path, stream->filename));
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &sb) == -1 || sb.st_size != stream->StreamSize) {
+		OC_DEBUG(0, "* Stream %s is incomplete", stream->key);
+		goto fail;
+	}
+
+	/* Someone else took over the in-flight file */
+	if (owned && (fstat(stream->fd, &sb_fd) == -1 ||
+		      sb_fd.st_ino != sb.st_ino || sb_fd.st_dev != sb.st_dev)) {
+		OC_DEBUG(0, "* In-flight file of stream %s was replaced", stream->key);
+		goto fail;
+	}
+
+	if (stream->StreamSize) {
+		data = (uint8_t *) mmap(NULL, stream->StreamSize, PROT_READ, MAP_SHARED, fd, 0);
+		if ((void *)data == MAP_FAILED) {
+			data = NULL;
+			goto fail;
+		}
+	}
+	hash = hash64_stable(data, stream->StreamSize, 0);
+
+	name = talloc_asprintf(mem_ctx, "%016"PRIx64"-%08x", hash, stream->StreamSize);
+	content = talloc_asprintf(mem_ctx, "%s/%s/%.2s", mpm->dbpath, MPM_DB_STORAGE, name);
+	if (mkdir(content, 0777) == -1 && errno != EEXIST) goto fail;
+	content = talloc_asprintf_append(content, "/%s", name);
+
+	fd_content = open(content, O_RDONLY);
+	if (fd_content != -1) {
+		/* Same name: check this is the same content */
+		if (stream->StreamSize) {
+			other = (uint8_t *) mmap(NULL, stream->StreamSize, PROT_READ, MAP_SHARED, fd_content, 0);
+		}
+		if (fstat(fd_content, &sb) == -1 || sb.st_size != stream->StreamSize ||
+		    (stream->StreamSize && ((void *)other == MAP_FAILED ||
+					    memcmp(data, other, stream->StreamSize)))) {
+			if (other && (void *)other != MAP_FAILED) munmap(other, stream->StreamSize);
+			close(fd_content);
+			OC_DEBUG(0, "* Hash collision on %s for stream %s", name, stream->key);
+			goto fail;
+		}
+		if (other) munmap(other, stream->StreamSize);
+		close(fd_content);
+		unlink(path);
+		OC_DEBUG(2, "* Stream %s shares content %s", stream->key, name);
+	} else {
+		if (rename(path, content) == -1) {
+			OC_DEBUG(0, "* Unable to store %s: %s", content, strerror(errno));
+			goto fail;
+		}
+		mpm->size += stream->StreamSize;
+		OC_DEBUG(2, "* Stream %s stored as %s", stream->key, name);
+	}
+
+	/* Link the key to the content, atomically replacing any old link */
+	link = talloc_asprintf(mem_ctx, "%s/%s/%s", mpm->dbpath, MPM_DB_KEYS, stream->key);
+	tmp = talloc_asprintf(mem_ctx, "%s.%d", link, (int)getpid());
+	unlink(tmp);
+	if (symlink(talloc_asprintf(mem_ctx, "../%s/%.2s/%s", MPM_DB_STORAGE, name, name), tmp) == -1 ||
+	    rename(tmp, link) == -1) {
+		OC_DEBUG(0, "* Unable to link %s: %s", link, strerror(errno));
+		unlink(tmp);
+	}
+
+	if (data) munmap(data, stream->StreamSize);
+	close(fd);
+
+	/* Serve the stream from the store from now on */
+	fd_content = open(content, O_RDONLY);
+	if (fd_content != -1) {
+		if (stream->state == MPM_STREAM_FETCH && !owned) {
+			mpm_cache_inflight_unlink(stream);
+		}
+		mpm_cache_stream_unmap(stream);
+		if (stream->fd != -1) close(stream->fd);
+		stream->fd = fd_content;
+		if (mpm_cache_stream_map(stream)) {
+			talloc_free(stream->filename);
+			stream->filename = talloc_strdup((TALLOC_CTX *)mpm, content);
+			stream->state = MPM_STREAM_CACHED;
+		} else {
+			stream->state = MPM_STREAM_SHARED;
+		}
+	}
+	talloc_free(mem_ctx);
+
+	if (mpm->max_size && mpm->size > mpm->max_size) {
+		mpm_cache_store_evict(mpm);
+	}
+
+	return NT_STATUS_OK;
+
+fail:
+	if (data) munmap(data, stream->StreamSize);
+	if (fd != -1) close(fd);
+	if (!owned) unlink(path);
+	if (stream->state == MPM_STREAM_FETCH) {
+		/* Keep reading what was written, nobody else will */
+		mpm_cache_inflight_unlink(stream);
+		stream->state = MPM_STREAM_SHARED;
+	}
+	talloc_free(mem_ctx);
+
+	return NT_STATUS_UNSUCCESSFUL;
+}
+
+
 /**
    \details Rewind a stream to the beginning
 
@@ -193,7 +789,6 @@ NTSTATUS mpm_cache_stream_write(struct mpm_stream *stream, uint16_t length, uint
  */
 NTSTATUS mpm_cache_stream_reset(struct mpm_stream *stream)
 {
-	fseek(stream->fp, 0, SEEK_SET);
 	stream->offset = 0;
 
 	return NT_STATUS_OK;
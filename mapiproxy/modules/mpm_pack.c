@@ -50,7 +50,8 @@ static uint32_t proxypack(TALLOC_CTX *mem_ctx, struct EcDoRpc_MAPI_REQ *mapi_req
 	size = 0;	
 	request.bin.cb = ndr->offset;
 	size += sizeof (uint16_t);
-	request.bin.lpb = talloc_memdup(mem_ctx, ndr->data, ndr->offset);
+	/* The caller frees ndr once packed, take over its buffer */
+	request.bin.lpb = talloc_steal(mem_ctx, ndr->data);
 	size += ndr->offset;
 
 	/* Fill the MAPI_REQ request */
@@ -35,6 +35,7 @@
 struct exchange_asyncemsmdb_session	*asyncemsmdb_session = NULL;
 void					*openchangedb_ctx = NULL;
 static struct ldb_context		*samdb_ctx = NULL;
+static struct asyncemsmdb_hub		*asyncemsmdb_hub = NULL;
 
 static struct exchange_asyncemsmdb_session *dcesrv_find_asyncemsmdb_session(struct GUID *uuid)
 {
@@ -80,7 +81,7 @@ static int _get_random_port(void)
 		return -1;
 	}
 
-	port = addr.sin_port;
+	port = ntohs(addr.sin_port);
 	close(sockfd);
 
 	return port;
@@ -435,11 +436,11 @@ static enum MAPISTATUS get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx, s
 		} else if (properties->aulPropTag[i] == PR_FOLDER_CHILD_COUNT) {
 			obj_count = talloc_zero(data_pointers, uint32_t);
 			MAPI_RETVAL_IF(!obj_count, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
-			retval = openchangedb_get_folder_count(openchangedb_ctx, p->username, folderId, obj_count);
+			retval = openchangedb_get_folder_count(p->oc_ctx, p->username, folderId, obj_count);
 			data_pointers[i] = obj_count;
 		} else if (properties->aulPropTag[i] == PR_SUBFOLDERS) {
 			obj_count = talloc_zero(NULL, uint32_t);
-			retval = openchangedb_get_folder_count(openchangedb_ctx, p->username, folderId, obj_count);
+			retval = openchangedb_get_folder_count(p->oc_ctx, p->username, folderId, obj_count);
 			has_subobj = talloc_zero(data_pointers, uint8_t);
 			MAPI_RETVAL_IF(!has_subobj, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 			*has_subobj = (*obj_count > 0) ? 1 : 0;
@@ -466,7 +467,7 @@ static enum MAPISTATUS get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx, s
 			retval = MAPI_E_SUCCESS;
 		}
 		else {
-			retval = openchangedb_get_folder_property(data_pointers, openchangedb_ctx, p->username,
+			retval = openchangedb_get_folder_property(data_pointers, p->oc_ctx, p->username,
 								  properties->aulPropTag[i], folderId, data_pointers + i);
 		}
 		retvals[i] = retval;
@@ -482,6 +483,7 @@ static enum MAPISTATUS get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx, s
 
    \param mem_ctx pointer to the memory context
    \param p pointer to the private asyncemsmdb data
+   \param batch pointer to the batch collecting notification blobs
    \param s pointer to the array of subscriptions for this session
    \param folderId the folder in which the tablemodified event occurred
 
@@ -493,6 +495,7 @@ static enum MAPISTATUS get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx, s
  */
 static int process_tablemodified_contentstable_notification(TALLOC_CTX *mem_ctx,
 							    struct asyncemsmdb_private_data *p,
+							    struct mapistore_notification_batch *batch,
 							    struct mapistore_notification_subscription *s,
 							    uint64_t folderId)
 {
@@ -546,7 +549,7 @@ static int process_tablemodified_contentstable_notification(TALLOC_CTX *mem_ctx,
 					return -1;
 				}
 
-				retval = openchangedb_get_mapistoreURI(mem_ctx, openchangedb_ctx,
+				retval = openchangedb_get_mapistoreURI(mem_ctx, p->oc_ctx,
 								       p->username, folderId,
 								       &mapistoreURI, true);
 				if (retval == MAPI_E_SUCCESS) {
@@ -618,7 +621,7 @@ static int process_tablemodified_contentstable_notification(TALLOC_CTX *mem_ctx,
 					return -1;
 				}
 
-				ret = mapistore_notification_deliver_add(p->mstore_ctx, p->emsmdb_uuid, ndr->data, ndr->offset);
+				ret = mapistore_notification_batch_deliver_add(batch, p->emsmdb_uuid, ndr->data, ndr->offset);
 				talloc_free(data_pointers);
 				talloc_free(retvals);
 				talloc_free(ndr);
@@ -634,13 +637,291 @@ static int process_tablemodified_contentstable_notification(TALLOC_CTX *mem_ctx,
 }
 
 
+/* Properties of the delivered message the rules are evaluated on */
+struct asyncemsmdb_rules_message {
+	struct SPropTagArray		*proptags;
+	struct mapistore_property_data	*prop_data;
+};
+
+static enum MAPISTATUS asyncemsmdb_rules_get_property(void *private_data, enum MAPITAGS proptag, void **data)
+{
+	struct asyncemsmdb_rules_message	*message = (struct asyncemsmdb_rules_message *) private_data;
+	uint32_t				i;
+
+	for (i = 0; i < message->proptags->cValues; i++) {
+		if (message->proptags->aulPropTag[i] != proptag) continue;
+		if (message->prop_data[i].error || !message->prop_data[i].data) {
+			return MAPI_E_NOT_FOUND;
+		}
+		*data = message->prop_data[i].data;
+		return MAPI_E_SUCCESS;
+	}
+
+	return MAPI_E_NOT_FOUND;
+}
+
+
+/**
+   \details Move or copy the delivered message to another folder of
+   the same mapistore context, as a move/copy rule action asks
+
+   \param mem_ctx pointer to the memory context
+   \param p pointer to the private asyncemsmdb data
+   \param contextID the context of the folder the message is in
+   \param folder_object the folder the message is in
+   \param mid the identifier of the message
+   \param action pointer to the move/copy action
+   \param want_copy whether the message is copied rather than moved
+   \param fidp pointer to the target folder identifier to return
+   \param midp pointer to the identifier of the message in the target
+   folder to return
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error asyncemsmdb_rules_move_copy(TALLOC_CTX *mem_ctx, struct asyncemsmdb_private_data *p,
+							uint32_t contextID, void *folder_object, uint64_t mid,
+							const struct MoveCopy_Action *action, bool want_copy,
+							uint64_t *fidp, uint64_t *midp)
+{
+	enum mapistore_error	ret;
+	enum MAPISTATUS		retval;
+	struct FolderEntryId	*entryid;
+	struct Binary_r		bin;
+	struct Binary_r		*change_key, *pcl;
+	struct UI8Array_r	*cns;
+	struct GUID		replica_guid;
+	uint16_t		replid;
+	uint64_t		target_fid, target_mid, gc;
+	void			*target_object;
+	int			i;
+
+	/* Only folders of the mailbox itself are reachable from here */
+	MAPISTORE_RETVAL_IF(!action->FolderInThisStore, MAPISTORE_ERR_NOT_IMPLEMENTED, NULL);
+
+	bin.cb = action->FolderEID.cb;
+	bin.lpb = action->FolderEID.lpb;
+	entryid = get_FolderEntryId(mem_ctx, &bin);
+	MAPISTORE_RETVAL_IF(!entryid, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	retval = openchangedb_get_MailboxReplica(p->oc_ctx, p->username, &replid, &replica_guid);
+	MAPISTORE_RETVAL_IF(retval, MAPISTORE_ERR_NOT_FOUND, NULL);
+	MAPISTORE_RETVAL_IF(!GUID_equal(&replica_guid, &entryid->FolderDatabaseGuid), MAPISTORE_ERR_NOT_IMPLEMENTED, NULL);
+	target_fid = (entryid->FolderGlobalCounter.value << 16) | replid;
+
+	/* The target must be a child of the context the message was
+	 * delivered to, the backend does the work in one step */
+	ret = mapistore_folder_open_folder(p->mstore_ctx, contextID, folder_object, mem_ctx, target_fid, &target_object);
+	MAPISTORE_RETVAL_IF(ret, ret, NULL);
+
+	ret = mapistore_indexing_get_new_folderID_as_user(p->mstore_ctx, p->username, &target_mid);
+	MAPISTORE_RETVAL_IF(ret, ret, NULL);
+
+	/* XID of a new change number, and a PCL made of this XID */
+	retval = openchangedb_get_new_changeNumbers(p->oc_ctx, mem_ctx, p->username, 1, &cns);
+	MAPISTORE_RETVAL_IF(retval, MAPISTORE_ERROR, NULL);
+	change_key = talloc_zero(mem_ctx, struct Binary_r);
+	pcl = talloc_zero(mem_ctx, struct Binary_r);
+	MAPISTORE_RETVAL_IF(!change_key || !pcl, MAPISTORE_ERR_NO_MEMORY, NULL);
+	change_key->cb = 22;
+	change_key->lpb = talloc_array(change_key, uint8_t, change_key->cb);
+	pcl->cb = change_key->cb + 1;
+	pcl->lpb = talloc_array(pcl, uint8_t, pcl->cb);
+	MAPISTORE_RETVAL_IF(!change_key->lpb || !pcl->lpb, MAPISTORE_ERR_NO_MEMORY, NULL);
+	memcpy(change_key->lpb, &replica_guid, 16);
+	gc = cns->lpui8[0] >> 16;
+	for (i = 0; i < 6; i++) {
+		change_key->lpb[16 + i] = gc & 0xff;
+		gc >>= 8;
+	}
+	pcl->lpb[0] = change_key->cb;
+	memcpy(pcl->lpb + 1, change_key->lpb, change_key->cb);
+
+	ret = mapistore_folder_move_copy_messages(p->mstore_ctx, contextID, target_object, folder_object, mem_ctx,
+						  1, &mid, &target_mid, &change_key, &pcl, want_copy);
+	MAPISTORE_RETVAL_IF(ret, ret, NULL);
+
+	/* Some backends register the records themselves */
+	ret = mapistore_indexing_record_add_fmids(p->mstore_ctx, contextID, p->username, 1, &target_mid, NULL);
+	if (ret != MAPISTORE_SUCCESS && ret != MAPISTORE_ERR_EXIST) {
+		OC_DEBUG(3, "unable to index message 0x%"PRIx64": %s", target_mid, mapistore_errstr(ret));
+	}
+	if (!want_copy) {
+		mapistore_indexing_record_del_fmids(p->mstore_ctx, contextID, p->username, 1, &mid, MAPISTORE_SOFT_DELETE);
+	}
+
+	*fidp = target_fid;
+	*midp = target_mid;
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Run the server-side rules of the folder a message was
+   delivered to
+
+   The rules set by the client with RopModifyRules are evaluated once,
+   here, instead of having every client download the message to run
+   them. Move, copy, delete, mark as read and tag actions are applied
+   to the message. Other actions (reply, forward, deferred client
+   actions...) are left to the client, which still sees the rule.
+
+   \param mem_ctx pointer to the memory context
+   \param p pointer to the private asyncemsmdb data
+   \param fidp pointer to the folder identifier of the message,
+   updated when a rule moves it
+   \param midp pointer to the message identifier, updated when a rule
+   moves it
+   \param deletedp pointer to the boolean set when a rule deletes the
+   message
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error process_newmail_rules(TALLOC_CTX *mem_ctx, struct asyncemsmdb_private_data *p,
+						  uint64_t *fidp, uint64_t *midp, bool *deletedp)
+{
+	TALLOC_CTX				*local_mem_ctx;
+	enum mapistore_error			ret;
+	enum MAPISTATUS				retval;
+	struct mapiproxy_rules			*rules;
+	const struct mapiproxy_rule		**matched;
+	struct asyncemsmdb_rules_message	message;
+	const struct ActionBlockData		*action;
+	struct SRow				row;
+	struct SPropValue			prop;
+	uint32_t				count, contextID, i, j;
+	uint64_t				fid = *fidp;
+	uint64_t				mid = *midp;
+	uint64_t				target_fid, target_mid;
+	char					*uri;
+	bool					soft_deleted;
+	bool					moved = false;
+	void					*folder_object, *message_object;
+
+	*deletedp = false;
+	if (asyncemsmdb_hub && !asyncemsmdb_hub->rules) return MAPISTORE_SUCCESS;
+
+	local_mem_ctx = talloc_new(mem_ctx);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* Folders without an openchangedb record have no rules */
+	retval = mapiproxy_rules_load(local_mem_ctx, p->oc_ctx, p->username, fid, &rules);
+	if (retval != MAPI_E_SUCCESS || !rules->count) {
+		talloc_free(local_mem_ctx);
+		return MAPISTORE_SUCCESS;
+	}
+
+	/* Open the message */
+	ret = mapistore_indexing_record_get_uri(p->mstore_ctx, p->username, local_mem_ctx, fid, &uri, &soft_deleted);
+	MAPISTORE_RETVAL_IF(ret, ret, local_mem_ctx);
+	ret = mapistore_search_context_by_uri(p->mstore_ctx, uri, &contextID, &folder_object);
+	if (ret == MAPISTORE_SUCCESS) {
+		ret = mapistore_add_context_ref_count(p->mstore_ctx, contextID);
+	} else {
+		ret = mapistore_add_context(p->mstore_ctx, p->username, uri, fid, &contextID, &folder_object);
+	}
+	MAPISTORE_RETVAL_IF(ret, ret, local_mem_ctx);
+
+	ret = mapistore_folder_open_message(p->mstore_ctx, contextID, folder_object, local_mem_ctx, mid, true, &message_object);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(3, "unable to open message 0x%"PRIx64" to run the rules: %s", mid, mapistore_errstr(ret));
+		goto end;
+	}
+
+	/* Fetch what the conditions read in a single call */
+	retval = mapiproxy_rules_get_proptags(local_mem_ctx, rules, &message.proptags);
+	if (retval != MAPI_E_SUCCESS) {
+		ret = MAPISTORE_ERR_NO_MEMORY;
+		goto end;
+	}
+	message.prop_data = talloc_zero_array(local_mem_ctx, struct mapistore_property_data, message.proptags->cValues + 1);
+	if (!message.prop_data) {
+		ret = MAPISTORE_ERR_NO_MEMORY;
+		goto end;
+	}
+	if (message.proptags->cValues) {
+		ret = mapistore_properties_get_properties(p->mstore_ctx, contextID, message_object, local_mem_ctx,
+							  message.proptags->cValues, message.proptags->aulPropTag,
+							  message.prop_data);
+		if (ret != MAPISTORE_SUCCESS) goto end;
+	}
+
+	retval = mapiproxy_rules_evaluate(local_mem_ctx, rules, asyncemsmdb_rules_get_property, &message, &matched, &count);
+	if (retval != MAPI_E_SUCCESS) {
+		ret = MAPISTORE_ERR_NO_MEMORY;
+		goto end;
+	}
+
+	for (i = 0; i < count && !moved && !*deletedp; i++) {
+		OC_DEBUG(5, "rule 0x%"PRIx64" matches message 0x%"PRIx64" of %s", matched[i]->id, mid, p->username);
+		for (j = 0; j < matched[i]->actions->count && !moved && !*deletedp; j++) {
+			action = &matched[i]->actions->ActionBlock[j].ActionBlockData;
+			switch (action->ActionType) {
+			case ActionType_OP_MARK_AS_READ:
+				ret = mapistore_message_set_read_flag(p->mstore_ctx, contextID, message_object,
+								      SUPPRESS_RECEIPT|CLEAR_RN_PENDING);
+				break;
+			case ActionType_OP_TAG:
+				cast_SPropValue(local_mem_ctx, (struct mapi_SPropValue *) &action->ActionDataBuffer.PropValue, &prop);
+				row.cValues = 1;
+				row.lpProps = &prop;
+				ret = mapistore_properties_set_properties(p->mstore_ctx, contextID, message_object, &row);
+				if (ret == MAPISTORE_SUCCESS) {
+					ret = mapistore_message_save(p->mstore_ctx, contextID, message_object, local_mem_ctx);
+				}
+				break;
+			case ActionType_OP_DELETE:
+				ret = mapistore_folder_delete_message(p->mstore_ctx, contextID, folder_object, mid, MAPISTORE_SOFT_DELETE);
+				if (ret == MAPISTORE_SUCCESS) {
+					mapistore_indexing_record_del_fmids(p->mstore_ctx, contextID, p->username, 1, &mid, MAPISTORE_SOFT_DELETE);
+					*deletedp = true;
+				}
+				break;
+			case ActionType_OP_MOVE:
+			case ActionType_OP_COPY:
+				ret = asyncemsmdb_rules_move_copy(local_mem_ctx, p, contextID, folder_object, mid,
+								  &action->ActionDataBuffer.MoveAction,
+								  action->ActionType == ActionType_OP_COPY, &target_fid, &target_mid);
+				/* A copy leaves the original message where it is */
+				if (ret == MAPISTORE_SUCCESS && action->ActionType == ActionType_OP_MOVE) {
+					*fidp = target_fid;
+					*midp = target_mid;
+					moved = true;
+				}
+				break;
+			default:
+				OC_DEBUG(5, "action 0x%x of rule 0x%"PRIx64" is left to the client",
+					 action->ActionType, matched[i]->id);
+				ret = MAPISTORE_SUCCESS;
+				break;
+			}
+			if (ret != MAPISTORE_SUCCESS) {
+				OC_DEBUG(3, "action 0x%x of rule 0x%"PRIx64" failed on message 0x%"PRIx64": %s",
+					 action->ActionType, matched[i]->id, mid, mapistore_errstr(ret));
+			}
+		}
+	}
+	ret = MAPISTORE_SUCCESS;
+
+end:
+	mapistore_del_context(p->mstore_ctx, contextID);
+	talloc_free(local_mem_ctx);
+
+	return ret;
+}
+
+
 /**
    \details Process newmail notification
 
    \param mem_ctx pointer to the memory context
    \param p pointer to the private asyncemsmdb data
+   \param batch pointer to the batch collecting notification blobs
    \param notif pointer to the mapistore newmail notification
    \param s pointer to the array of subscriptions for this session
+   \param fidp pointer to the folder identifier the message was
+   delivered to, or moved to by a server-side rule, for the
+   TableModified notification the caller raises
 
    \note newmail notification (popup) will only be triggered for
    emails delivered to Inbox. However, TableModified notification
@@ -652,20 +933,22 @@ static int process_tablemodified_contentstable_notification(TALLOC_CTX *mem_ctx,
  */
 static int process_newmail_notification(TALLOC_CTX *mem_ctx,
 					struct asyncemsmdb_private_data *p,
+					struct mapistore_notification_batch *batch,
 					struct mapistore_notification *notif,
-					struct mapistore_notification_subscription *s)
+					struct mapistore_notification_subscription *s,
+					uint64_t *fidp)
 {
 	int				i;
 	int				index = -1;
 	enum MAPISTATUS			retval;
 	enum mapistore_error		ret;
-	int				rval;
 	struct indexing_context		*ictx;
 	uint64_t			fid;
 	uint64_t			mid;
 	char				*folder_uri = NULL;
 	char				*message_uri = NULL;
 	bool				soft_deleted;
+	bool				deleted = false;
 	struct EcDoRpc_MAPI_REPL	reply;
 	struct ndr_push			*ndr;
 	enum ndr_err_code		ndr_err_code;
@@ -683,27 +966,27 @@ static int process_newmail_notification(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Check if we need to register message in a different folder than Inbox */
-	if (notif->v.v1.u.newmail.folder && (notif->v.v1.u.newmail.folder[0] == '\0')) {
+	if (notif->v.v2.u.newmail.folder && (notif->v.v2.u.newmail.folder[0] == '\0')) {
 		/* Retrieve Inbox FID */
-		retval = openchangedb_get_SystemFolderID(openchangedb_ctx, p->username, ASYNCEMSMDB_INBOX_SYSTEMIDX, &fid);
+		retval = openchangedb_get_SystemFolderID(p->oc_ctx, p->username, ASYNCEMSMDB_INBOX_SYSTEMIDX, &fid);
 		if (retval != MAPI_E_SUCCESS) {
 			OC_DEBUG(0, "Failed to retrieve Inbox FolderId for user %s", p->username);
 			return -1;
 		}
 
 		/* Fetch the Inbox folder mapistore URI */
-		retval = openchangedb_get_mapistoreURI(mem_ctx, openchangedb_ctx, p->username, fid, &folder_uri, true);
+		retval = openchangedb_get_mapistoreURI(mem_ctx, p->oc_ctx, p->username, fid, &folder_uri, true);
 		if (retval != MAPI_E_SUCCESS) {
 			OC_DEBUG(0, "Failed to retrieve Inbox mapistore URI for user %s", p->username);
 			return -1;
 		}
 	} else {
 		/* handle sogo url case here */
-		if (!strcmp(notif->v.v1.u.newmail.backend, "sogo")) {
+		if (!strcmp(notif->v.v2.u.newmail.backend, "sogo")) {
 			bool	soft_deletep;
 
-			ret = build_mapistore_sogo_url(mem_ctx, "mail", p->username, notif->v.v1.u.newmail.folder,
-						       notif->v.v1.u.newmail.separator, &folder_uri);
+			ret = build_mapistore_sogo_url(mem_ctx, "mail", p->username, notif->v.v2.u.newmail.folder,
+						       notif->v.v2.u.newmail.separator, &folder_uri);
 			if (ret != MAPISTORE_SUCCESS) {
 				OC_DEBUG(0, "Unable to generate sogo URL");
 				return -1;
@@ -728,7 +1011,7 @@ static int process_newmail_notification(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Build the message URI: append folderID with message id */
-	message_uri = talloc_asprintf(mem_ctx, "%s%s", folder_uri, notif->v.v1.u.newmail.eml);
+	message_uri = talloc_asprintf(mem_ctx, "%s%s", folder_uri, notif->v.v2.u.newmail.eml);
 	talloc_free(folder_uri);
 	if (!message_uri) {
 		OC_DEBUG(0, "Unable to allocate memory");
@@ -760,6 +1043,16 @@ static int process_newmail_notification(TALLOC_CTX *mem_ctx,
 	}
 	talloc_free(message_uri);
 
+	/* Run the server-side rules once, when the message is registered */
+	ret = process_newmail_rules(mem_ctx, p, &fid, &mid, &deleted);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(3, "Unable to run the rules on message 0x%"PRIx64" of %s: %s", mid, p->username, mapistore_errstr(ret));
+	}
+	if (deleted) {
+		*fidp = fid;
+		return 0;
+	}
+
 	/* Generate Notify_reply blob */
 process:
 	memset(&reply, 0, sizeof(struct EcDoRpc_MAPI_REPL));
@@ -788,49 +1081,371 @@ process:
 		return -1;
 	}
 
-	ret = mapistore_notification_deliver_add(p->mstore_ctx, p->emsmdb_uuid, ndr->data, ndr->offset);
+	ret = mapistore_notification_batch_deliver_add(batch, p->emsmdb_uuid, ndr->data, ndr->offset);
 	talloc_free(ndr);
 	if (ret != MAPISTORE_SUCCESS) {
 		OC_DEBUG(0, "Unable to deliver notification blob");
 		return -1;
 	}
 
-	rval = process_tablemodified_contentstable_notification(mem_ctx, p, s, fid);
-	if (rval != 0) {
-		OC_DEBUG(0, "TableModified notification failed");
+	*fidp = fid;
+	return 0;
+}
+
+/**
+   \details Unpack the next notification of a message received on the
+   hub socket
+
+   \param mem_ctx pointer to the memory context
+   \param ndr_pull pointer to the NDR context over the received message
+   \param np pointer on pointer to the notification to return
+
+   \return 0 on success, otherwise -1
+ */
+static int asyncemsmdb_notification_unpack(TALLOC_CTX *mem_ctx, struct ndr_pull *ndr_pull,
+					   struct mapistore_notification **np)
+{
+	struct mapistore_notification	*n;
+	struct ndr_print		*ndr_print;
+	enum ndr_err_code		ndr_err_code;
+
+	n = talloc_zero(mem_ctx, struct mapistore_notification);
+	if (!n) {
+		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
+		return -1;
+	}
+	ndr_pull->current_mem_ctx = n;
+
+	ndr_err_code = ndr_pull_mapistore_notification(ndr_pull, NDR_SCALARS, n);
+	if (ndr_err_code != NDR_ERR_SUCCESS) {
+		OC_DEBUG(0, "[asyncemsmdb]: Invalid mapistore_notification structure");
+		talloc_free(n);
+		return -1;
+	}
+
+	/* Sanity checks on notification payload */
+	if (n->vnum >= MAPISTORE_NOTIFICATION_VMAX) {
+		OC_DEBUG(0, "[asyncemsmdb]: Invalid version, expected at max %d but got %d",
+			 MAPISTORE_NOTIFICATION_VMAX - 1, n->vnum);
+		talloc_free(n);
+		return -1;
+	}
+
+	/* v1 publishers do not name the recipient: upgrade the
+	 * notification and let the dispatcher resolve it */
+	if (n->vnum == MAPISTORE_NOTIFICATION_V1) {
+		struct notification_v1	v1 = n->v.v1;
+
+		n->vnum = MAPISTORE_NOTIFICATION_V2;
+		n->v.v2.cn = NULL;
+		n->v.v2.flags = v1.flags;
+		n->v.v2.u = v1.u;
+	} else if (n->vnum != MAPISTORE_NOTIFICATION_V2 || !n->v.v2.cn) {
+		OC_DEBUG(0, "[asyncemsmdb]: Notification has no recipient");
+		talloc_free(n);
+		return -1;
+	}
+
+	ndr_print = talloc_zero(mem_ctx, struct ndr_print);
+	if (ndr_print) {
+		ndr_print->depth = 1;
+		ndr_print->print = ndr_print_debug_helper;
+		ndr_print->no_newline = false;
+		ndr_print_mapistore_notification(ndr_print, "notification", n);
+		talloc_free(ndr_print);
 	}
 
+	*np = n;
 	return 0;
 }
 
-static void EcDoAsyncWaitEx_handler(struct tevent_context *ev,
-				    struct tevent_fd *fde,
-				    uint16_t flags,
-				    void *private_data)
+
+/**
+   \details Unpack the notifications of a message received on the hub
+   socket. Publishers may concatenate several notifications in a
+   single message.
+
+   \param mem_ctx pointer to the memory context
+   \param str pointer to the received message
+   \param bytes length of the received message
+   \param notificationsp pointer to the array of notifications to append to
+   \param countp pointer to the number of entries in the array
+
+   \return the number of notifications unpacked
+ */
+static uint32_t asyncemsmdb_message_unpack(TALLOC_CTX *mem_ctx, char *str, int bytes,
+					   struct mapistore_notification ***notificationsp,
+					   uint32_t *countp)
+{
+	struct mapistore_notification	**notifications = *notificationsp;
+	struct mapistore_notification	*n;
+	struct ndr_pull			*ndr_pull;
+	DATA_BLOB			blob;
+	uint32_t			unpacked = 0;
+
+	blob.data = (uint8_t *) str;
+	blob.length = bytes;
+	ndr_pull = ndr_pull_init_blob(&blob, mem_ctx);
+	if (!ndr_pull) {
+		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
+		return 0;
+	}
+	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+
+	while (ndr_pull->offset < ndr_pull->data_size) {
+		/* a malformed notification leaves no way to find the next one */
+		if (asyncemsmdb_notification_unpack(mem_ctx, ndr_pull, &n) != 0) break;
+
+		notifications = talloc_realloc(mem_ctx, notifications, struct mapistore_notification *,
+					       *countp + 1);
+		if (!notifications) {
+			OC_DEBUG(0, "[asyncemsmdb]: No more memory");
+			talloc_free(n);
+			break;
+		}
+		(void) talloc_steal(notifications, n);
+		notifications[(*countp)++] = n;
+		*notificationsp = notifications;
+		unpacked++;
+	}
+
+	talloc_free(ndr_pull);
+	return unpacked;
+}
+
+
+/**
+   \details Process the notifications received for a session in a
+   single pass: the subscriptions are fetched once and the Notify
+   blobs generated for all the events are written in a single
+   exchange
+
+   \param p pointer to the asyncemsmdb private data of the session
+   \param notifications array of notifications to process
+   \param count number of entries in notifications
+
+   \return the number of notifications processed, otherwise -1
+ */
+static int asyncemsmdb_process_notifications(struct asyncemsmdb_private_data *p,
+					     struct mapistore_notification **notifications,
+					     uint32_t count)
 {
-	struct asyncemsmdb_private_data			*p = talloc_get_type(private_data,
-									     struct asyncemsmdb_private_data);
 	TALLOC_CTX					*mem_ctx;
 	enum mapistore_error				retval;
-	int						ret;
-	DATA_BLOB					blob;
-	char						*str = NULL;
-	int						bytes = 0;
-	NTSTATUS					status;
 	struct mapistore_notification_subscription	r;
-	struct mapistore_notification			n;
+	struct mapistore_notification_batch		*batch;
 	struct ndr_print				*ndr_print;
-	struct ndr_pull					*ndr_pull;
-	enum ndr_err_code				ndr_err_code;
+	uint64_t					*fids;
+	uint64_t					fid;
+	uint32_t					fid_count = 0;
+	uint32_t					i, j;
+	int						processed = 0;
+	int						ret;
 
-	if (!p) {
-		OC_DEBUG(0, "[asyncemsmdb]: private_data is NULL");
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) {
+		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
+		return -1;
+	}
+
+	OC_DEBUG(5, "%d notification(s) received for session: %s", count, p->emsmdb_session_str);
+
+	/* Only the subscriptions for the events handled below */
+	retval = mapistore_notification_subscription_find(mem_ctx, p->mstore_ctx, p->emsmdb_uuid,
+							  sub_NewMail|sub_TableModified, 0, &r);
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "no subscription to process");
+		talloc_free(mem_ctx);
+		return -1;
+	}
+
+	OC_DEBUG(5, "%d subscriptions available:", r.v.v1.count);
+	ndr_print = talloc_zero(mem_ctx, struct ndr_print);
+	if (ndr_print) {
+		ndr_print->depth = 1;
+		ndr_print->print = ndr_print_debug_helper;
+		ndr_print->no_newline = false;
+		ndr_print_mapistore_notification_subscription(ndr_print, "subscriptions", &r);
+		talloc_free(ndr_print);
+	}
+
+	retval = mapistore_notification_batch_init(mem_ctx, p->mstore_ctx, &batch);
+	fids = talloc_array(mem_ctx, uint64_t, count);
+	if (retval != MAPISTORE_SUCCESS || !fids) {
+		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
+		talloc_free(mem_ctx);
+		return -1;
+	}
+
+	/* Process notifications */
+	for (i = 0; i < count; i++) {
+		switch (notifications[i]->v.v2.flags) {
+		case (sub_NewMail):
+			ret = process_newmail_notification(mem_ctx, p, batch, notifications[i], &r, &fid);
+			if (ret) {
+				OC_DEBUG(0, "[asyncemsmdb]: Failed to process newmail notification (error=0x%x)", ret);
+				continue;
+			}
+			for (j = 0; j < fid_count && fids[j] != fid; j++);
+			if (j == fid_count) {
+				fids[fid_count++] = fid;
+			}
+			break;
+		default:
+			OC_DEBUG(0, "[asyncemsmdb]: Unsupported notification 0x%x", notifications[i]->v.v2.flags);
+			continue;
+		}
+		processed++;
+	}
+
+	/* The folder row only changes once, whatever the number of
+	 * messages delivered to the folder */
+	for (i = 0; i < fid_count; i++) {
+		ret = process_tablemodified_contentstable_notification(mem_ctx, p, batch, &r, fids[i]);
+		if (ret != 0) {
+			OC_DEBUG(0, "TableModified notification failed");
+		}
+	}
+
+	retval = mapistore_notification_batch_commit(batch);
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "[asyncemsmdb]: Unable to deliver notification blobs: %s", mapistore_errstr(retval));
+	}
+	talloc_free(mem_ctx);
+
+	return processed;
+}
+
+
+/**
+   \details Complete the pending EcDoAsyncWaitEx call of a session. If
+   the client has no call pending, the notification is remembered and
+   the next EcDoAsyncWaitEx call returns immediately.
+
+   \param p pointer to the asyncemsmdb private data of the session
+ */
+static void asyncemsmdb_reply(struct asyncemsmdb_private_data *p)
+{
+	NTSTATUS	status;
+
+	if (p->timer) {
+		talloc_free(p->timer);
+		p->timer = NULL;
+	}
+
+	if (!p->r) {
+		p->pending = true;
+		return;
+	}
+
+	p->r->out.pulFlagsOut = talloc_zero(p->dce_call, uint32_t);
+	*p->r->out.pulFlagsOut = 0x1;
+
+	status = dcesrv_reply(p->dce_call);
+	if (!NT_STATUS_IS_OK(status)) {
+		OC_DEBUG(0, "asyncemsmdb_reply: dcesrv_reply() failed - %s", nt_errstr(status));
+	}
+
+	p->dce_call = NULL;
+	p->r = NULL;
+	p->pending = false;
+}
+
+
+static void asyncemsmdb_reply_handler(struct tevent_context *ev,
+				      struct tevent_timer *te,
+				      struct timeval current_time,
+				      void *private_data)
+{
+	struct asyncemsmdb_private_data	*p = talloc_get_type(private_data,
+							     struct asyncemsmdb_private_data);
+
+	/* The timer is released by tevent once the handler returns */
+	p->timer = NULL;
+	asyncemsmdb_reply(p);
+}
+
+
+/**
+   \details Wake up a session after a notification was processed.
+   The reply is delayed by the coalescing window of the hub, so the
+   events following in the meantime are fetched by the client with
+   the same EcDoRpc call instead of one at a time.
+
+   \param hub pointer to the notification hub
+   \param p pointer to the asyncemsmdb private data of the session
+ */
+static void asyncemsmdb_reply_coalesced(struct asyncemsmdb_hub *hub,
+					struct asyncemsmdb_private_data *p)
+{
+	if (!p->r || !hub->coalesce_window) {
+		asyncemsmdb_reply(p);
 		return;
 	}
 
-	bytes = nn_recv(p->sock, &str, NN_MSG, NN_DONTWAIT);
-	if (bytes == 0) {
-		OC_DEBUG(0, "[asyncemsmdb]: EcDoAsyncWaitEx_handler: str is NULL!");
+	/* A reply is already scheduled for this session */
+	if (p->timer) return;
+
+	p->timer = tevent_add_timer(hub->ev, p, timeval_current_ofs_msec(hub->coalesce_window),
+				    asyncemsmdb_reply_handler, p);
+	if (!p->timer) {
+		asyncemsmdb_reply(p);
+	}
+}
+
+
+/**
+   \details Find the recipient of notifications which do not name it.
+   v1 publishers resolved the hub address for a single user, which is
+   only unambiguous while all the sessions bound to the hub belong to
+   the same user.
+
+   \return the cn shared by all the sessions, otherwise NULL
+ */
+static const char *asyncemsmdb_hub_single_cn(void)
+{
+	struct exchange_asyncemsmdb_session	*session;
+	const char				*cn = NULL;
+
+	for (session = asyncemsmdb_session; session; session = session->next) {
+		if (!session->data || !session->cn) continue;
+		if (!cn) {
+			cn = session->cn;
+		} else if (strcmp(cn, session->cn)) {
+			return NULL;
+		}
+	}
+
+	return cn;
+}
+
+
+/**
+   \details Read the notifications queued on the hub socket and
+   dispatch them to the sessions of their recipient. Notifications
+   read in the same pass are coalesced into a single reply per
+   session.
+ */
+static void asyncemsmdb_hub_handler(struct tevent_context *ev,
+				    struct tevent_fd *fde,
+				    uint16_t flags,
+				    void *private_data)
+{
+	struct asyncemsmdb_hub			*hub = talloc_get_type(private_data, struct asyncemsmdb_hub);
+	struct exchange_asyncemsmdb_session	*session;
+	struct mapistore_notification		**notifications = NULL;
+	struct mapistore_notification		**matches;
+	TALLOC_CTX				*mem_ctx;
+	uint32_t				received = 0;
+	uint32_t				count = 0;
+	uint32_t				match_count;
+	uint32_t				i;
+	char					*str = NULL;
+	const char				*single_cn;
+	int					bytes;
+
+	if (!hub) {
+		OC_DEBUG(0, "[asyncemsmdb]: private_data is NULL");
 		return;
 	}
 
@@ -840,85 +1455,176 @@ static void EcDoAsyncWaitEx_handler(struct tevent_context *ev,
 		return;
 	}
 
-	blob.data = (uint8_t *) str;
-	blob.length = bytes;
-	ndr_pull = ndr_pull_init_blob(&blob, mem_ctx);
-	if (!ndr_pull) {
+	while (received++ < ASYNCEMSMDB_HUB_RECV_MAX) {
+		bytes = nn_recv(hub->sock, &str, NN_MSG, NN_DONTWAIT);
+		if (bytes < 0) break;
+
+		if (bytes > 0) {
+			asyncemsmdb_message_unpack(mem_ctx, str, bytes, &notifications, &count);
+		} else {
+			OC_DEBUG(0, "[asyncemsmdb]: asyncemsmdb_hub_handler: empty message");
+		}
 		nn_freemsg(str);
-		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
-		return;
 	}
-	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
 
-	ndr_err_code = ndr_pull_mapistore_notification(ndr_pull, NDR_SCALARS, &n);
-	nn_freemsg(str);
-	if (ndr_err_code != NDR_ERR_SUCCESS) {
-		OC_DEBUG(0, "[asyncemsmdb]: Invalid mapistore_notification structure");
+	if (!count) {
 		talloc_free(mem_ctx);
 		return;
 	}
 
-	/* Sanity checks on notification payload */
-	if (n.vnum >= MAPISTORE_NOTIFICATION_VMAX) {
-		OC_DEBUG(0, "[asyncemsmdb]: Invalid version, expected at max %d but got %d",
-			 MAPISTORE_NOTIFICATION_VMAX - 1, n.vnum);
+	matches = talloc_array(mem_ctx, struct mapistore_notification *, count);
+	if (!matches) {
+		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
 		talloc_free(mem_ctx);
 		return;
 	}
 
-	ndr_print = talloc_zero(mem_ctx, struct ndr_print);
-	if (!ndr_print) {
-		OC_DEBUG(0, "[asyncemsmdb]: No more memory");
-		talloc_free(mem_ctx);
-		return;
+	single_cn = asyncemsmdb_hub_single_cn();
+	for (i = 0; i < count; i++) {
+		if (notifications[i]->v.v2.cn) continue;
+		if (single_cn) {
+			notifications[i]->v.v2.cn = single_cn;
+		} else {
+			OC_DEBUG(0, "[asyncemsmdb]: Dropping v1 notification, several users share the hub");
+		}
 	}
-	ndr_print->depth = 1;
-	ndr_print->print = ndr_print_debug_helper;
-	ndr_print->no_newline = false;
 
-	ndr_print_mapistore_notification(ndr_print, "notification", &n);
+	/* openchangedb is shared with the emsmdb workers */
+	mapiproxy_server_lock();
+	for (session = asyncemsmdb_session; session; session = session->next) {
+		if (!session->data || !session->cn) continue;
 
-	OC_DEBUG(5, "Notification received for session: %s", p->emsmdb_session_str);
+		match_count = 0;
+		for (i = 0; i < count; i++) {
+			if (notifications[i]->v.v2.cn && !strcmp(notifications[i]->v.v2.cn, session->cn)) {
+				matches[match_count++] = notifications[i];
+			}
+		}
+		if (!match_count) continue;
 
-	retval = mapistore_notification_subscription_get(mem_ctx, p->mstore_ctx, p->emsmdb_uuid, &r);
-	if (retval != MAPISTORE_SUCCESS) {
-		OC_DEBUG(0, "no subscription to process");
-		talloc_free(mem_ctx);
-		return;
+		if (asyncemsmdb_process_notifications(session->data, matches, match_count) > 0) {
+			asyncemsmdb_reply_coalesced(hub, session->data);
+		}
 	}
+	mapiproxy_server_unlock();
 
-	OC_DEBUG(5, "%d subscriptions available:", r.v.v1.count);
-	ndr_print_mapistore_notification_subscription(ndr_print, "subscriptions", &r);
-	talloc_free(ndr_print);
+	talloc_free(mem_ctx);
+}
 
-	/* Process notifications */
-	switch (n.v.v1.flags) {
-	case (sub_NewMail):
-		ret = process_newmail_notification(mem_ctx, p, &n, &r);
-		if (ret) {
-			OC_DEBUG(0, "[asyncemsmdb]: Failed to process newmail notification (error=0x%x)", ret);
-			talloc_free(mem_ctx);
-			return;
-		}
-		break;
-	default:
-		OC_DEBUG(0, "[asyncemsmdb]: Unsupported notification 0x%x", n.v.v1.flags);
-		talloc_free(mem_ctx);
-		return;
+
+/**
+   \details Release the hub socket
+
+   \param data pointer on the hub to destroy
+
+   \return 0 on success
+ */
+static int asyncemsmdb_hub_destructor(void *data)
+{
+	struct asyncemsmdb_hub	*hub = (struct asyncemsmdb_hub *) data;
+
+	talloc_free(hub->fd_event);
+	if (hub->sock != -1) {
+		nn_close(hub->sock);
 	}
-	talloc_free(ndr_pull);
-	talloc_free(mem_ctx);
 
-	p->r->out.pulFlagsOut = talloc_zero(p->dce_call, uint32_t);
-	*p->r->out.pulFlagsOut = 0x1;
+	return 0;
+}
 
-	status = dcesrv_reply(p->dce_call);
-	if (!NT_STATUS_IS_OK(status)) {
-		OC_DEBUG(0, "EcDoAsyncWaitEx_handler: dcesrv_reply() failed - %s", nt_errstr(status));
+
+/**
+   \details Return the notification hub of the current process,
+   creating it on first use. All the asyncemsmdb sessions of the
+   process share its socket and register its address in the resolver.
+
+   \param dce_call pointer to the session context
+
+   \return pointer to the hub on success, otherwise NULL
+ */
+static struct asyncemsmdb_hub *asyncemsmdb_hub_get(struct dcesrv_call_state *dce_call)
+{
+	struct asyncemsmdb_hub	*hub;
+	const char		*ip_addr;
+	size_t			sz;
+	int			port;
+
+	if (asyncemsmdb_hub && asyncemsmdb_hub->pid == getpid()) {
+		return asyncemsmdb_hub;
+	}
+	/* A hub inherited from the parent process belongs to the parent */
+	asyncemsmdb_hub = NULL;
+
+	hub = talloc_zero(NULL, struct asyncemsmdb_hub);
+	if (!hub) {
+		OC_DEBUG(0, "[asyncemsmdb]: no more memory");
+		return NULL;
+	}
+	hub->pid = getpid();
+
+	hub->sock = nn_socket(AF_SP, NN_PULL);
+	if (hub->sock == -1) {
+		OC_DEBUG(0, "[asyncemsmdb]: failed to create socket: %s", nn_strerror(errno));
+		talloc_free(hub);
+		return NULL;
+	}
+	talloc_set_destructor((void *)hub, (int (*)(void *))asyncemsmdb_hub_destructor);
+
+	/* Get a random port */
+	port = _get_random_port();
+	if (port == -1) {
+		OC_DEBUG(0, "[asyncemsmdb]: no port available!");
+		talloc_free(hub);
+		return NULL;
+	}
+
+	/* Get parametric options */
+	ip_addr = lpcfg_parm_string(dce_call->conn->dce_ctx->lp_ctx, NULL, "asyncemsmdb", "listen");
+	if (ip_addr == NULL) {
+		OC_DEBUG(0, "[asyncemsmdb]: no asyncemsmdb:listen option specified, "
+			 "using %s as a fallback", ASYNCEMSMDB_FALLBACK_ADDR);
+		ip_addr = ASYNCEMSMDB_FALLBACK_ADDR;
+	}
+
+	/* TODO: Add transport as a parametric option */
+	hub->bind_addr = talloc_asprintf(hub, "tcp://%s:%d", ip_addr, port);
+	if (!hub->bind_addr) {
+		OC_DEBUG(0, "[asyncemsmdb][ERR]: no more memory");
+		talloc_free(hub);
+		return NULL;
 	}
 
-	talloc_free(p->fd_event);
-	p->fd_event = NULL;
+	if (nn_bind(hub->sock, hub->bind_addr) == -1) {
+		OC_DEBUG(0, "[asyncemsmdb] nn_bind failed on %s failed: %s", hub->bind_addr, nn_strerror(errno));
+		talloc_free(hub);
+		return NULL;
+	}
+
+	sz = sizeof(hub->fd);
+	if (nn_getsockopt(hub->sock, NN_SOL_SOCKET, NN_RCVFD, &hub->fd, &sz) == -1) {
+		OC_DEBUG(0, "[asyncemsmdb] nn_getsockopt failed: %s", nn_strerror(errno));
+		talloc_free(hub);
+		return NULL;
+	}
+
+	hub->coalesce_window = lpcfg_parm_int(dce_call->conn->dce_ctx->lp_ctx, NULL, "asyncemsmdb",
+					      "coalesce_window", ASYNCEMSMDB_COALESCE_WINDOW);
+	if (hub->coalesce_window < 0) {
+		hub->coalesce_window = 0;
+	}
+	hub->rules = lpcfg_parm_bool(dce_call->conn->dce_ctx->lp_ctx, NULL, "asyncemsmdb", "server_rules", true);
+
+	hub->ev = dce_call->event_ctx;
+	hub->fd_event = tevent_add_fd(dce_call->event_ctx, hub, hub->fd, TEVENT_FD_READ,
+				      asyncemsmdb_hub_handler, hub);
+	if (hub->fd_event == NULL) {
+		OC_DEBUG(0, "[asyncemsmdb] unable to subscribe for fd event in event loop");
+		talloc_free(hub);
+		return NULL;
+	}
+
+	OC_DEBUG(3, "[asyncemsmdb]: notification hub listening on %s", hub->bind_addr);
+	asyncemsmdb_hub = hub;
+	return hub;
 }
 
 
@@ -931,21 +1637,18 @@ static void EcDoAsyncWaitEx_handler(struct tevent_context *ev,
 
    \return NT_STATUS_OK on success
  */
-static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
-				       TALLOC_CTX *mem_ctx,
-				       struct EcDoAsyncWaitEx *r)
+static NTSTATUS asyncemsmdb_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
+					    TALLOC_CTX *mem_ctx,
+					    struct EcDoAsyncWaitEx *r)
 {
 	enum mapistore_error			retval;
 	struct exchange_asyncemsmdb_session	*session = NULL;
 	struct asyncemsmdb_private_data		*p = NULL;
+	struct asyncemsmdb_hub			*hub = NULL;
 	struct mapistore_context		*mstore_ctx = NULL;
+	void					*oc_ctx = NULL;
 	struct GUID				uuid;
 	char					*cn = NULL;
-	const char				*ip_addr = NULL;
-	int					nn_retval;
-	size_t					sz = 0;
-	char					*bind_addr = NULL;
-	int					port = 0;
 
 	OC_DEBUG(3, "exchange_asyncemsmdb: EcDoAsyncWaitEx (0x0)");
 
@@ -971,10 +1674,26 @@ static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
 			return NT_STATUS_OK;
 		}
 
+		/* Notifications were processed since the last reply */
+		if (p->pending) {
+			dce_call->state_flags &= ~DCESRV_CALL_STATE_FLAG_ASYNC;
+			p->pending = false;
+			*r->out.pulFlagsOut = 0x1;
+			return NT_STATUS_OK;
+		}
+
 		p->dce_call = dce_call;
 		p->r = r;
 	} else {
 		/* Step 1. Ensure the session is registered */
+		oc_ctx = mapiproxy_server_openchangedb_user_init(dce_call->conn->dce_ctx->lp_ctx,
+								 dcesrv_call_account_name(dce_call));
+		if (!oc_ctx) {
+			OC_DEBUG(0, "[asyncemsmdb]: no openchangedb available");
+			*r->out.pulFlagsOut = 0x1;
+			return NT_STATUS_OK;
+		}
+
 		mstore_ctx = mapistore_init(mem_ctx, dce_call->conn->dce_ctx->lp_ctx, NULL);
 		if (!mstore_ctx) {
 			OC_DEBUG(0, "[asyncemsmdb]: MAPIStore initialized failed");
@@ -982,7 +1701,7 @@ static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
 			return NT_STATUS_OK;
 		}
 
-		retval = mapistore_set_connection_info(mstore_ctx, samdb_ctx, openchangedb_ctx,
+		retval = mapistore_set_connection_info(mstore_ctx, samdb_ctx, oc_ctx,
 						       dcesrv_call_account_name(dce_call));
 		if (retval != MAPISTORE_SUCCESS) {
 			OC_DEBUG(0, "[asyncemsmdb]: unable to set mapistore connection info");
@@ -1010,6 +1729,7 @@ static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
 
 		p->dce_call = dce_call;
 		p->mstore_ctx = talloc_steal(p, mstore_ctx);
+		p->oc_ctx = oc_ctx;
 		p->emsmdb_uuid = uuid;
 		p->username = (char *) dcesrv_call_account_name(dce_call);
 		p->emsmdb_session_str = GUID_string(p, (const struct GUID *)&uuid);
@@ -1019,78 +1739,27 @@ static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
 			return NT_STATUS_OK;
 		}
 		p->r = r;
-		p->fd_event = NULL;
-
-		p->sock = nn_socket(AF_SP, NN_PULL);
-		if (p->sock == -1) {
-			OC_DEBUG(0, "[asyncemsmdb]: failed to create socket: %s", nn_strerror(errno));
-			talloc_free(p);
-			return NT_STATUS_OK;
-		}
-
-		/* Get a random port */
-		port = _get_random_port();
-		if (port == -1) {
-			OC_DEBUG(0, "[asyncemsmdb]: no port available!");
-			talloc_free(p);
-			return NT_STATUS_OK;
-		}
-
-		/* Get parametric options */
-		ip_addr = lpcfg_parm_string(dce_call->conn->dce_ctx->lp_ctx, NULL, "asyncemsmdb", "listen");
-		if (ip_addr == NULL) {
-			OC_DEBUG(0, "[asyncemsmdb]: no asyncemsmdb:listen option specified, "
-				 "using %s as a fallback", ASYNCEMSMDB_FALLBACK_ADDR);
-			ip_addr = ASYNCEMSMDB_FALLBACK_ADDR;
-		}
-
-		/* TODO: Add transport as a parametric option */
-		bind_addr = talloc_asprintf(mem_ctx, "tcp://%s:%d", ip_addr, port);
-		if (!bind_addr) {
-			OC_DEBUG(0, "[asyncemsmdb][ERR]: no more memory");
-			talloc_free(p);
-			return NT_STATUS_OK;
-		}
 
-		nn_retval = nn_bind(p->sock, bind_addr);
-		if (nn_retval == -1) {
-			OC_DEBUG(0, "[asyncemsmdb] nn_bind failed on %s failed: %s", bind_addr, nn_strerror(errno));
+		/* Subscribe to the notification hub of this process */
+		hub = asyncemsmdb_hub_get(dce_call);
+		if (!hub) {
 			talloc_free(p);
-			talloc_free(bind_addr);
 			return NT_STATUS_OK;
 		}
 
-		/* Register the address to the resolver */
-		retval = mapistore_notification_resolver_add(p->mstore_ctx, cn, bind_addr);
-		if (retval != MAPISTORE_SUCCESS) {
+		/* Register the hub address to the resolver, once per cn */
+		retval = mapistore_notification_resolver_add(p->mstore_ctx, cn, hub->bind_addr);
+		if (retval != MAPISTORE_SUCCESS && retval != MAPISTORE_ERR_EXIST) {
 			OC_DEBUG(0, "[asyncemsmdb] unable to add record to the resolver: %s",
 				 mapistore_errstr(retval));
 			talloc_free(p);
-			talloc_free(bind_addr);
 			return NT_STATUS_OK;
 		}
 
-		sz = sizeof(p->fd);
-		nn_retval = nn_getsockopt(p->sock, NN_SOL_SOCKET, NN_RCVFD, &p->fd, &sz);
-		if (nn_retval == -1) {
-			OC_DEBUG(0, "[asyncemsmdb] nn_getsockopt failed: %s", nn_strerror(errno));
-			talloc_free(p);
-			talloc_free(bind_addr);
-			return NT_STATUS_OK;
-		}
-	}
-
-	if (!p->fd_event) {
-		p->fd_event = tevent_add_fd(dce_call->event_ctx,
-					    dce_call->event_ctx,
-					    p->fd,
-					    TEVENT_FD_READ,
-					    EcDoAsyncWaitEx_handler,
-					    p);
-		if (p->fd_event == NULL) {
-			OC_DEBUG(0, "[asyncemsmdb] unable to subscribe for fd event in event loop");
-			return NT_STATUS_OK;
-		}
+		/* The emsmdb session subscribed to the notification bus
+		 * when it connected this pipe, possibly from a process
+		 * the bus has not seen yet */
+		mapistore_notification_bus_refresh(p->mstore_ctx);
 	}
 
 	/* Register session  */
@@ -1110,8 +1779,7 @@ static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
 			talloc_free(session);
 			goto failure;
 		}
-		session->bind_addr = talloc_strdup(session, bind_addr);
-		talloc_free(bind_addr);
+		session->bind_addr = talloc_strdup(session, hub->bind_addr);
 		if (!session->bind_addr) {
 			talloc_free(session);
 			goto failure;
@@ -1128,10 +1796,36 @@ static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
 	return NT_STATUS_OK;
 }
 
+
+/**
+   \details Run EcDoAsyncWaitEx holding the server lock, as samdb and
+   openchangedb are shared with the emsmdb workers
+
+   \param dce_call pointer to the session context
+   \param mem_ctx pointer to the memory context
+   \param r pointer to the EcDoAsyncWaitEx request data
+
+   \return NT_STATUS_OK on success
+ */
+static NTSTATUS dcesrv_EcDoAsyncWaitEx(struct dcesrv_call_state *dce_call,
+				       TALLOC_CTX *mem_ctx,
+				       struct EcDoAsyncWaitEx *r)
+{
+	NTSTATUS	status;
+
+	mapiproxy_server_lock();
+	status = asyncemsmdb_EcDoAsyncWaitEx(dce_call, mem_ctx, r);
+	mapiproxy_server_unlock();
+
+	return status;
+}
+
 static NTSTATUS dcerpc_server_asyncemsmdb_unbind(struct dcesrv_connection_context *context, const struct dcesrv_interface *iface)
 {
 	enum mapistore_error			retval;
 	struct exchange_asyncemsmdb_session	*session = (struct exchange_asyncemsmdb_session *) context->private_data;
+	struct exchange_asyncemsmdb_session	*el;
+	bool					shared = false;
 
 	OC_DEBUG(3, "dcerpc_server_asyncemsmdb_unbind");
 
@@ -1139,13 +1833,28 @@ static NTSTATUS dcerpc_server_asyncemsmdb_unbind(struct dcesrv_connection_contex
 		return NT_STATUS_OK;
 	}
 
+	mapiproxy_server_lock();
+
+	/* The hub address stays registered while another session of this cn uses it */
+	for (el = asyncemsmdb_session; !shared && el; el = el->next) {
+		if (el != session && el->cn && !strcmp(el->cn, session->cn)) {
+			shared = true;
+		}
+	}
+
 	OC_DEBUG(5, "[asyncemsmdb] unbind %s", session->bind_addr);
-	retval = mapistore_notification_resolver_delete(session->mstore_ctx, session->cn, session->bind_addr);
-	if (retval != MAPISTORE_SUCCESS) {
-		OC_DEBUG(0, "[asyncemsmdb] unable to delete resolver entry %s from record %s", session->bind_addr, session->cn);
+	if (!shared) {
+		retval = mapistore_notification_resolver_delete(session->mstore_ctx, session->cn, session->bind_addr);
+		if (retval != MAPISTORE_SUCCESS) {
+			OC_DEBUG(0, "[asyncemsmdb] unable to delete resolver entry %s from record %s", session->bind_addr, session->cn);
+		}
 	}
 
 	DLIST_REMOVE(asyncemsmdb_session, session);
+	context->private_data = NULL;
+	talloc_free(session);
+
+	mapiproxy_server_unlock();
 
 	/* flush pending call on connection */
 	context->conn->pending_call_list = NULL;
@@ -1154,44 +1863,9 @@ static NTSTATUS dcerpc_server_asyncemsmdb_unbind(struct dcesrv_connection_contex
 }
 
 
-/**
-   \details Initialize ldb_context to samdb, creates one for all emsmdbp
-   contexts
-
-   \param lp_ctx pointer to the loadparm context
- */
-static struct ldb_context *samdb_init(struct loadparm_context *lp_ctx)
-{
-	TALLOC_CTX		*mem_ctx;
-	struct tevent_context	*ev;
-	const char		*samdb_url;
-	struct ldb_context	*_samdb_ctx;
-
-	if (samdb_ctx) return samdb_ctx;
-
-	mem_ctx = talloc_autofree_context();
-	ev = tevent_context_init(mem_ctx);
-	if (!ev) {
-		return NULL;
-	}
-	tevent_loop_allow_nesting(ev);
-
-	/* Retrieve samdb url (local or external) */
-	samdb_url = lpcfg_parm_string(lp_ctx, NULL, "dcerpc_mapiproxy", "samdb_url");
-
-	if (!samdb_url) {
-		_samdb_ctx = samdb_connect(mem_ctx, ev, lp_ctx, system_session(lp_ctx), 0);
-	} else {
-		_samdb_ctx = samdb_connect_url(mem_ctx, ev, lp_ctx, system_session(lp_ctx),
-					       LDB_FLG_RECONNECT, samdb_url);
-	}
-
-	return _samdb_ctx;
-}
-
-
 static NTSTATUS dcerpc_server_asyncemsmdb_bind(struct dcesrv_call_state *dce_call, const struct dcesrv_interface *iface)
 {
+	mapiproxy_server_lock();
 	if (!openchangedb_ctx) {
 		openchangedb_ctx = mapiproxy_server_openchangedb_init(dce_call->conn->dce_ctx->lp_ctx);
 		if (!openchangedb_ctx) {
@@ -1200,11 +1874,12 @@ static NTSTATUS dcerpc_server_asyncemsmdb_bind(struct dcesrv_call_state *dce_cal
 	}
 
 	if (!samdb_ctx) {
-		samdb_ctx = samdb_init(dce_call->conn->dce_ctx->lp_ctx);
+		samdb_ctx = mapiproxy_server_samdb_init(dce_call->conn->dce_ctx->lp_ctx);
 		if (!samdb_ctx) {
 			OC_PANIC(true, ("Unable to initialize samdb"));
 		}
 	}
+	mapiproxy_server_unlock();
 
 	dce_call->state_flags |= DCESRV_CALL_STATE_FLAG_PROCESS_PENDING_CALL;
 	return NT_STATUS_OK;
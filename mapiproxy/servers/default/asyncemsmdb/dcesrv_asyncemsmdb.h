@@ -38,13 +38,25 @@ struct asyncemsmdb_private_data {
 	struct dcesrv_call_state		*dce_call;
 	struct EcDoAsyncWaitEx			*r;
 	struct mapistore_context		*mstore_ctx;
+	void					*oc_ctx;	/* openchangedb of the user */
 	char					*username;
 	char					*emsmdb_session_str;
 	struct GUID				emsmdb_uuid;
-	struct tevent_fd			*fd_event;
+	bool					pending;
+	struct tevent_timer			*timer;
+	int					lock;
+};
+
+/* Per-process notification socket shared by all the sessions */
+struct asyncemsmdb_hub {
+	pid_t					pid;
 	int					sock;
 	int					fd;
-	int					lock;
+	char					*bind_addr;
+	int					coalesce_window;
+	bool					rules;	/* run server-side rules on delivery */
+	struct tevent_context			*ev;
+	struct tevent_fd			*fd_event;
 };
 
 struct exchange_asyncemsmdb_session {
@@ -76,16 +88,12 @@ NTSTATUS dcerpc_server_asyncemsmdb_init(void);
 NTSTATUS ndr_table_register(const struct ndr_interface_table *);
 NTSTATUS samba_init_module(void);
 
-
-/* Expose samdb_connect prototype */
-struct ldb_context *samdb_connect(TALLOC_CTX *, struct tevent_context *, struct loadparm_context *, struct auth_session_info *, unsigned int);
-struct ldb_context *samdb_connect_url(TALLOC_CTX *, struct tevent_context *, struct loadparm_context *, struct auth_session_info *, unsigned int, const char *);
-void tevent_loop_allow_nesting(struct tevent_context *);
-
 __END_DECLS
 
 #define	ASYNCEMSMDB_FALLBACK_ADDR	"127.0.0.1"
 #define	ASYNCEMSMDB_INBOX_SYSTEMIDX	13
+#define	ASYNCEMSMDB_HUB_RECV_MAX	64
+#define	ASYNCEMSMDB_COALESCE_WINDOW	100
 
 #define	ASYNCEMSMDB_SPACE		' '
 #define	ASYNCEMSMDB_SOGO_SPACE		"_SP_"
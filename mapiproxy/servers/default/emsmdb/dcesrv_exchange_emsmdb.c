@@ -30,39 +30,179 @@
 #include "mapiproxy/dcesrv_mapiproxy.h"
 #include "mapiproxy/libmapiproxy/fault_util.h"
 #include "mapiproxy/libmapiserver/libmapiserver.h"
+#include "mapiproxy/util/ccan/htable/htable.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
+#include "mapiproxy/util/trace.h"
 #include "dcesrv_exchange_emsmdb.h"
 
 struct exchange_emsmdb_session		*emsmdb_session = NULL;
 void					*openchange_db_ctx = NULL;
 
+/* Live sessions are indexed by their policy handle GUID, which is what
+ * every EcDoRpc/EcDoRpcExt2 call provides, and by the (server_id,
+ * context_id) pair used on unbind */
+static size_t emsmdb_session_rehash_uuid(const void *e, void *unused);
+static size_t emsmdb_session_rehash_conn(const void *e, void *unused);
+
+static struct htable	emsmdb_session_uuid_ht = HTABLE_INITIALIZER(emsmdb_session_uuid_ht, emsmdb_session_rehash_uuid, NULL);
+static struct htable	emsmdb_session_conn_ht = HTABLE_INITIALIZER(emsmdb_session_conn_ht, emsmdb_session_rehash_conn, NULL);
+static uint32_t		emsmdb_session_count = 0;
+
+/* Bounds of the talloc pool the ROPs of an EcDoRpc call allocate
+ * from, sized after the calls processed before */
+#define	EMSMDB_ROP_POOL_MIN_SIZE	(16 * 1024)
+#define	EMSMDB_ROP_POOL_MAX_SIZE	(1024 * 1024)
+
+static size_t		emsmdb_rop_pool_size = EMSMDB_ROP_POOL_MIN_SIZE;
+
+static size_t emsmdb_session_hash_uuid(const struct GUID *uuid)
+{
+	return hash_any(uuid, sizeof (struct GUID), 0);
+}
+
+static size_t emsmdb_session_hash_conn(const struct server_id *server_id, uint32_t context_id)
+{
+	uint32_t	key[4];
+
+	key[0] = (uint32_t) server_id->pid;
+	key[1] = (uint32_t) (server_id->pid >> 32);
+	key[2] = server_id->task_id;
+	key[3] = server_id->vnn;
+
+	return hash_u32(key, 4, context_id);
+}
+
+static size_t emsmdb_session_rehash_uuid(const void *e, void *unused)
+{
+	return emsmdb_session_hash_uuid(&((const struct exchange_emsmdb_session *)e)->uuid);
+}
+
+static size_t emsmdb_session_rehash_conn(const void *e, void *unused)
+{
+	const struct exchange_emsmdb_session	*session = (const struct exchange_emsmdb_session *)e;
+
+	return emsmdb_session_hash_conn(&session->session->server_id, session->session->context_id);
+}
+
+static bool emsmdb_session_cmp_uuid(const void *e, void *uuid)
+{
+	return GUID_equal((const struct GUID *)uuid, &((const struct exchange_emsmdb_session *)e)->uuid);
+}
+
+struct emsmdb_session_conn_key {
+	const struct server_id	*server_id;
+	uint32_t		context_id;
+};
+
+static bool emsmdb_session_cmp_conn(const void *e, void *k)
+{
+	const struct exchange_emsmdb_session	*session = (const struct exchange_emsmdb_session *)e;
+	const struct emsmdb_session_conn_key	*key = (const struct emsmdb_session_conn_key *)k;
+
+	return (session->session->context_id == key->context_id &&
+		session->session->server_id.pid == key->server_id->pid &&
+		session->session->server_id.task_id == key->server_id->task_id &&
+		session->session->server_id.vnn == key->server_id->vnn);
+}
+
 static struct exchange_emsmdb_session *dcesrv_find_emsmdb_session(struct GUID *uuid)
 {
-	struct exchange_emsmdb_session	*session, *found_session = NULL;
+	return htable_get(&emsmdb_session_uuid_ht, emsmdb_session_hash_uuid(uuid),
+			  emsmdb_session_cmp_uuid, uuid);
+}
+
+static struct exchange_emsmdb_session *dcesrv_find_emsmdb_session_by_server_id(const struct server_id *server_id, uint32_t context_id)
+{
+	struct emsmdb_session_conn_key	key;
 
-	for (session = emsmdb_session; !found_session && session; session = session->next) {
-		if (GUID_equal(uuid, &session->uuid)) {
-			found_session = session;
-		}
+	key.server_id = server_id;
+	key.context_id = context_id;
+
+	return htable_get(&emsmdb_session_conn_ht, emsmdb_session_hash_conn(server_id, context_id),
+			  emsmdb_session_cmp_conn, &key);
+}
+
+/**
+   \details Register a newly created session in the session registry
+
+   \param session pointer to the session to register
+
+   \return true on success, otherwise false
+ */
+static bool dcesrv_add_emsmdb_session(struct exchange_emsmdb_session *session)
+{
+	if (!session || !session->session) return false;
+
+	if (!htable_add(&emsmdb_session_uuid_ht, emsmdb_session_rehash_uuid(session, NULL), session)) {
+		return false;
+	}
+	if (!htable_add(&emsmdb_session_conn_ht, emsmdb_session_rehash_conn(session, NULL), session)) {
+		htable_del(&emsmdb_session_uuid_ht, emsmdb_session_rehash_uuid(session, NULL), session);
+		return false;
 	}
+	emsmdb_session_count++;
+	mapiproxy_stats_add(MAPIPROXY_STATS_EMSMDB_SESSIONS, 1);
+
+	return true;
+}
+
+/**
+   \details Remove a session from the session registry. The session
+   itself is not released.
+
+   \param session pointer to the session to unregister
+ */
+static void dcesrv_remove_emsmdb_session(struct exchange_emsmdb_session *session)
+{
+	bool	found;
 
-	return found_session;
+	if (!session) return;
+
+	found = htable_del(&emsmdb_session_uuid_ht, emsmdb_session_rehash_uuid(session, NULL), session);
+	htable_del(&emsmdb_session_conn_ht, emsmdb_session_rehash_conn(session, NULL), session);
+	if (found && emsmdb_session_count) {
+		emsmdb_session_count--;
+		mapiproxy_stats_add(MAPIPROXY_STATS_EMSMDB_SESSIONS, -1);
+	}
 }
 
-/* FIXME: See _unbind below */
-/* static struct exchange_emsmdb_session *dcesrv_find_emsmdb_session_by_server_id(const struct server_id *server_id, uint32_t context_id) */
-/* { */
-/* 	struct exchange_emsmdb_session	*session; */
+/**
+   \details Release a reference on a registered session. The session is
+   unregistered and freed when its last reference goes away.
+
+   \param session pointer to the session to release
+
+   \return true if the session was released, false if only its
+   ref_count was decreased
+ */
+static bool dcesrv_release_emsmdb_session(struct exchange_emsmdb_session *session)
+{
+	bool	ret;
+
+	if (!session || !session->session) return false;
+
+	if (session->session->ref_count) {
+		return mpm_session_release(session->session);
+	}
+
+	dcesrv_remove_emsmdb_session(session);
+	ret = mpm_session_release(session->session);
+	if (ret == true) {
+		talloc_free(session);
+	}
+
+	return ret;
+}
 
-/* 	for (session = emsmdb_session; session; session = session->next) { */
-/* 		if (session->session */
-/* 		    && session->session->server_id.id == server_id->id && session->session->server_id.id2 == server_id->id2 && session->session->server_id.node == server_id->node */
-/* 		    && session->session->context_id == context_id) { */
-/* 			return session; */
-/* 		} */
-/* 	} */
+/**
+   \details Return the number of live EMSMDB sessions
 
-/* 	return NULL; */
-/* } */
+   \return number of sessions currently registered
+ */
+_PUBLIC_ uint32_t dcesrv_emsmdb_session_count(void)
+{
+	return emsmdb_session_count;
+}
 
 /**
    \details exchange_emsmdb EcDoConnect (0x0) function
@@ -129,6 +269,7 @@ static enum MAPISTATUS dcesrv_EcDoConnect(struct dcesrv_call_state *dce_call,
 		OC_PANIC(false, ("[exchange_emsmdb] EcDoConnect failed: unable to initialize emsmdbp context\n"));
 		goto failure;
 	}
+	emsmdbp_ctx->ev_ctx = dce_call->event_ctx;
 
 	/* Step 2. Check if incoming user belongs to the Exchange organization */
 	if (emsmdbp_verify_user(dce_call, emsmdbp_ctx) == false) {
@@ -222,9 +363,13 @@ static enum MAPISTATUS dcesrv_EcDoConnect(struct dcesrv_call_state *dce_call,
 		mpm_session_set_private_data(session->session, (void *) emsmdbp_ctx);
 		mpm_session_set_destructor(session->session, emsmdbp_destructor);
 
-		OC_DEBUG(0, "[exchange_emsmdb]: New session added: %d\n", session->session->context_id);
-
-		DLIST_ADD_END(emsmdb_session, session, struct exchange_emsmdb_session *);
+		if (dcesrv_add_emsmdb_session(session) == false) {
+			OC_DEBUG(0, "[exchange_emsmdb]: Unable to register session %d\n", session->session->context_id);
+			talloc_free(session);
+			return MAPI_E_NOT_ENOUGH_RESOURCES;
+		}
+		OC_DEBUG(0, "[exchange_emsmdb]: New session added: %d (%"PRIu32" live)\n",
+			 session->session->context_id, emsmdb_session_count);
 	}
 
 	return MAPI_E_SUCCESS;
@@ -261,9 +406,8 @@ static enum MAPISTATUS dcesrv_EcDoDisconnect(struct dcesrv_call_state *dce_call,
 	if (h) {
 		session = dcesrv_find_emsmdb_session(&r->in.handle->uuid);
 		if (session) {
-			ret = mpm_session_release(session->session);
+			ret = dcesrv_release_emsmdb_session(session);
 			if (ret == true) {
-				DLIST_REMOVE(emsmdb_session, session);
 				OC_DEBUG(5, "Session found and released\n");
 			} else {
 				OC_DEBUG(5, "Session found and ref_count decreased\n");
@@ -281,26 +425,309 @@ static enum MAPISTATUS dcesrv_EcDoDisconnect(struct dcesrv_call_state *dce_call,
 	return MAPI_E_SUCCESS;
 }
 
-static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx, 
-							 struct emsmdbp_context *emsmdbp_ctx,
-							 struct mapi_request *mapi_request)
+/**
+   \details Tell whether a Rop leaves the content of every table
+   unchanged, so that the rows cached by QueryRows remain valid.
+
+   Unknown or writing Rops are conservatively considered as modifying.
+
+   \param opnum the Rop identifier
+
+   \return true if the Rop does not alter table contents, otherwise false
+ */
+static bool EcDoRpc_rop_preserves_tables(uint8_t opnum)
+{
+	switch (opnum) {
+	case op_MAPI_Release:
+	case op_MAPI_OpenFolder:
+	case op_MAPI_OpenMessage:
+	case op_MAPI_GetHierarchyTable:
+	case op_MAPI_GetContentsTable:
+	case op_MAPI_GetProps:
+	case op_MAPI_GetPropsAll:
+	case op_MAPI_GetPropList:
+	case op_MAPI_SetColumns:
+	case op_MAPI_SortTable:
+	case op_MAPI_Restrict:
+	case op_MAPI_QueryRows:
+	case op_MAPI_QueryPosition:
+	case op_MAPI_SeekRow:
+	case op_MAPI_SeekRowBookmark:
+	case op_MAPI_CreateBookmark:
+	case op_MAPI_FreeBookmark:
+	case op_MAPI_ExpandRow:
+	case op_MAPI_CollapseRow:
+	case op_MAPI_GetCollapseState:
+	case op_MAPI_SetCollapseState:
+	case op_MAPI_GetAttachmentTable:
+	case op_MAPI_OpenAttach:
+	case op_MAPI_GetReceiveFolder:
+	case op_MAPI_RegisterNotification:
+	case op_MAPI_ReadStream:
+	case op_MAPI_SeekStream:
+	case op_MAPI_GetSearchCriteria:
+	case op_MAPI_GetPermissionsTable:
+	case op_MAPI_GetRulesTable:
+	case op_MAPI_LongTermIdFromId:
+	case op_MAPI_IdFromLongTermId:
+	case op_MAPI_FastTransferSourceCopyTo:
+	case op_MAPI_FastTransferSourceGetBuffer:
+	case op_MAPI_FindRow:
+	case op_MAPI_GetNamesFromIDs:
+	case op_MAPI_GetIDsFromNames:
+	case op_MAPI_GetStreamSize:
+	case op_MAPI_GetPerUserLongTermIds:
+	case op_MAPI_GetPerUserGuid:
+	case op_MAPI_GetReceiveFolderTable:
+	case op_MAPI_GetTransportFolder:
+	case op_MAPI_SyncConfigure:
+	case op_MAPI_SyncUploadStateStreamBegin:
+	case op_MAPI_SyncUploadStateStreamContinue:
+	case op_MAPI_SyncUploadStateStreamEnd:
+	case op_MAPI_GetStoreState:
+	case op_MAPI_SyncOpenCollector:
+	case op_MAPI_ResetTable:
+	case op_MAPI_SyncGetTransferState:
+	case op_MAPI_Logon:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+   \details Marshal a ROP reply at the end of the response being built
+
+   Replies are marshalled once, as soon as they are filled, and the
+   response is sent from these bytes: its size is the offset of the
+   ndr context, the ROP handlers don't compute it. A reply that can't
+   be marshalled is replaced with a MAPI_E_CALL_FAILED one.
+
+   \param ndr pointer to the ndr push context of the response
+   \param mapi_repl pointer to the reply to marshal
+ */
+static void EcDoRpc_push_reply(struct ndr_push *ndr, struct EcDoRpc_MAPI_REPL *mapi_repl)
+{
+	uint32_t		offset;
+	enum ndr_err_code	ndr_err_code;
+
+	offset = ndr->offset;
+	ndr_err_code = ndr_push_EcDoRpc_MAPI_REPL(ndr, NDR_SCALARS, mapi_repl);
+	if (ndr_err_code == NDR_ERR_SUCCESS) return;
+
+	OC_DEBUG(0, "Unable to marshal the reply of Rop 0x%.2x: %d", mapi_repl->opnum, ndr_err_code);
+	ndr->offset = offset;
+	mapi_repl->error_code = MAPI_E_CALL_FAILED;
+	ndr_err_code = ndr_push_EcDoRpc_MAPI_REPL(ndr, NDR_SCALARS, mapi_repl);
+	if (ndr_err_code != NDR_ERR_SUCCESS) {
+		ndr->offset = offset;
+	}
+}
+
+/**
+   \details Create the memory context the ROPs of a call allocate
+   their transient data from
+
+   It is a talloc pool sized after the memory used by the previous
+   calls, so most allocations are taken from a single chunk which is
+   released along with the call memory context. Data kept by objects
+   outliving the call must be allocated on them or copied: a reference
+   to pool memory would keep the whole chunk.
+
+   \param mem_ctx pointer to the call memory context
+   \param lp_ctx pointer to the loadparm context
+
+   \return the ROP memory context on success, otherwise NULL
+ */
+static TALLOC_CTX *EcDoRpc_rop_pool_init(TALLOC_CTX *mem_ctx, struct loadparm_context *lp_ctx)
+{
+	int	max_size;
+
+	max_size = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "rop_pool_max_size", EMSMDB_ROP_POOL_MAX_SIZE);
+	if (max_size <= 0) {
+		return talloc_named_const(mem_ctx, 0, "EcDoRpc_rop_ctx");
+	}
+	if (emsmdb_rop_pool_size > (size_t) max_size) {
+		emsmdb_rop_pool_size = max_size;
+	}
+
+	return talloc_pool(mem_ctx, emsmdb_rop_pool_size);
+}
+
+/**
+   \details Account the memory used by the ROPs of a call in the size
+   of the next pools
+ */
+static void EcDoRpc_rop_pool_update(TALLOC_CTX *rop_ctx)
+{
+	size_t	used;
+
+	used = talloc_total_size(rop_ctx);
+	emsmdb_rop_pool_size = (emsmdb_rop_pool_size * 7 + used) / 8;
+	if (emsmdb_rop_pool_size < EMSMDB_ROP_POOL_MIN_SIZE) {
+		emsmdb_rop_pool_size = EMSMDB_ROP_POOL_MIN_SIZE;
+	} else if (emsmdb_rop_pool_size > EMSMDB_ROP_POOL_MAX_SIZE) {
+		emsmdb_rop_pool_size = EMSMDB_ROP_POOL_MAX_SIZE;
+	}
+}
+
+/**
+   \details Retrieve the notifications delivered to a session, including
+   those a MAPI/HTTP NotificationWait already fetched
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param payload pointer to the blob to return
+
+   \return MAPISTORE_SUCCESS if notifications are returned, otherwise
+   MAPISTORE error
+ */
+static enum mapistore_error EcDoRpc_fetch_notifications(TALLOC_CTX *mem_ctx,
+							struct emsmdbp_context *emsmdbp_ctx,
+							DATA_BLOB *payload)
+{
+	enum mapistore_error	ret;
+	DATA_BLOB		fetched;
+	uint8_t			*data;
+
+	ret = mapistore_notification_bus_fetch(mem_ctx, emsmdbp_ctx->mstore_ctx, emsmdbp_ctx->session_uuid,
+					       &fetched.data, &fetched.length);
+	if (!emsmdbp_ctx->notifications.length) {
+		*payload = fetched;
+		return ret;
+	}
+
+	*payload = emsmdbp_ctx->notifications;
+	talloc_steal(mem_ctx, payload->data);
+	emsmdbp_ctx->notifications = data_blob_null;
+	if (ret == MAPISTORE_SUCCESS) {
+		data = talloc_realloc(mem_ctx, payload->data, uint8_t, payload->length + fetched.length);
+		if (data) {
+			memcpy(data + payload->length, fetched.data, fetched.length);
+			payload->data = data;
+			payload->length += fetched.length;
+		}
+		talloc_free(fetched.data);
+	}
+
+	return MAPISTORE_SUCCESS;
+}
+
+/**
+   \details Answer a ROP delayed by admission control with ecServerBusy
+   and record it in the RopBackoff reply of its logon
+
+   \param mem_ctx pointer to the memory context
+   \param mapi_req pointer to the delayed ROP request
+   \param mapi_repl pointer to the ROP reply to fill
+   \param duration the number of milliseconds the client should wait
+   \param backoffs pointer to the RopBackoff replies of the call
+   \param backoff_count pointer to the number of RopBackoff replies
+ */
+static void EcDoRpc_backoff_rop(TALLOC_CTX *mem_ctx,
+				    struct EcDoRpc_MAPI_REQ *mapi_req,
+				    struct EcDoRpc_MAPI_REPL *mapi_repl,
+				    uint32_t duration,
+				    struct Backoff_repl **backoffs,
+				    uint32_t *backoff_count)
+{
+	struct Backoff_repl	*backoff = NULL;
+	struct Backoff_repl	*grown;
+	struct BackoffRop	*rops;
+	uint32_t		i;
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = ecServerBusy;
+	if (mapi_req->opnum == op_MAPI_FastTransferSourceGetBuffer) {
+		mapi_repl->us.mapi_FastTransferSourceGetBuffer.BackoffTime = duration;
+	}
+
+	for (i = 0; i < *backoff_count; i++) {
+		if ((*backoffs)[i].LogonId == mapi_req->logon_id) {
+			backoff = &(*backoffs)[i];
+			break;
+		}
+	}
+	if (!backoff) {
+		grown = talloc_realloc(mem_ctx, *backoffs, struct Backoff_repl, *backoff_count + 1);
+		if (!grown) return;
+		*backoffs = grown;
+		backoff = &grown[*backoff_count];
+		memset(backoff, 0, sizeof (struct Backoff_repl));
+		backoff->LogonId = mapi_req->logon_id;
+		(*backoff_count)++;
+	}
+
+	/* Only the bulk ROPs wait, not the whole logon */
+	for (i = 0; i < backoff->BackoffRopCount; i++) {
+		if (backoff->BackoffRopData[i].RopIdBackoff == mapi_req->opnum) {
+			if (duration > backoff->BackoffRopData[i].Duration) {
+				backoff->BackoffRopData[i].Duration = duration;
+			}
+			return;
+		}
+	}
+	if (backoff->BackoffRopCount == UINT8_MAX) return;
+
+	rops = talloc_realloc(*backoffs, backoff->BackoffRopData, struct BackoffRop, backoff->BackoffRopCount + 1);
+	if (!rops) return;
+	rops[backoff->BackoffRopCount].RopIdBackoff = mapi_req->opnum;
+	rops[backoff->BackoffRopCount].Duration = duration;
+	backoff->BackoffRopData = rops;
+	backoff->BackoffRopCount++;
+}
+
+static struct mapi_response *EcDoRpc_process_request(TALLOC_CTX *mem_ctx,
+						     struct emsmdbp_context *emsmdbp_ctx,
+						     struct mapi_request *mapi_request,
+						     bool notifications)
 {
 	enum MAPISTATUS		retval;
+	TALLOC_CTX		*rop_ctx;
 	struct mapi_response	*mapi_response;
+	struct EcDoRpc_MAPI_REPL	*mapi_repl;
+	struct ndr_push		*repl_ndr;
 	uint32_t		handles_length;
+	uint32_t		count;
+	enum emsmdbp_memory_state	memory_state;
 	uint16_t		size = 0;
 	uint32_t		i;
 	uint32_t		idx;
+	struct timespec		start;
+	bool			stats;
+	bool			load;
+	bool			failed;
+	uint32_t		backoff;
+	struct Backoff_repl	*backoffs = NULL;
+	uint32_t		backoff_count = 0;
+	struct oc_trace_span	transaction_span;
+	struct oc_trace_span	rop_span;
 
 	/* Sanity checks */
 	if (!emsmdbp_ctx) return NULL;
 	if (!mapi_request) return NULL;
 
+	stats = emsmdbp_stats_init(emsmdbp_ctx->lp_ctx);
+	load = emsmdbp_load_begin(emsmdbp_ctx->lp_ctx);
+	emsmdbp_idle_touch(emsmdbp_ctx);
+	memory_state = emsmdbp_memory_sample(emsmdbp_ctx);
+	oc_trace_span_begin(&transaction_span, __FUNCTION__, 0);
+
 	/* Allocate mapi_response */
 	mapi_response = talloc_zero(mem_ctx, struct mapi_response);
 	mapi_response->handles = mapi_request->handles;
 	mapi_response->mapi_repl = NULL;
 
+	/* The replies are marshalled into it as they are filled */
+	repl_ndr = ndr_push_init_ctx(mapi_response);
+	if (!repl_ndr) {
+		OC_DEBUG(0, "No memory available");
+		idx = 0;
+		goto end;
+	}
+	ndr_set_flags(&repl_ndr->flags, LIBNDR_FLAG_NOALIGN);
+
 	/* Step 1. Handle Idle requests case */
 	if (mapi_request->mapi_len <= 2) {
 		mapi_response->mapi_len = 2;
@@ -308,286 +735,343 @@ static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
 		goto notif;
 	}
 
-	/* Step 2. Process serialized MAPI requests */
-	mapi_response->mapi_repl = talloc_zero(mem_ctx, struct EcDoRpc_MAPI_REPL);
-	for (i = 0, idx = 0, size = 0; mapi_request->mapi_req[i].opnum != 0; i++) {
-		OC_DEBUG(0, "MAPI Rop: 0x%.2x (%d)\n", mapi_request->mapi_req[i].opnum, size);
-
+	/* Step 2. Process serialized MAPI requests: every ROP but Release
+	   has a reply */
+	for (i = 0, count = 0; mapi_request->mapi_req[i].opnum != 0; i++) {
 		if (mapi_request->mapi_req[i].opnum != op_MAPI_Release) {
-			mapi_response->mapi_repl = talloc_realloc(mem_ctx, mapi_response->mapi_repl,
-								  struct EcDoRpc_MAPI_REPL, idx + 2);
+			count++;
+		}
+	}
+	mapi_response->mapi_repl = talloc_zero_array(mem_ctx, struct EcDoRpc_MAPI_REPL, count + 1);
+	if (!mapi_response->mapi_repl) {
+		OC_DEBUG(0, "No memory available");
+		idx = 0;
+		goto end;
+	}
+
+	rop_ctx = EcDoRpc_rop_pool_init(mem_ctx, emsmdbp_ctx->lp_ctx);
+	if (!rop_ctx) {
+		rop_ctx = mem_ctx;
+	}
+
+	for (i = 0, idx = 0; mapi_request->mapi_req[i].opnum != 0; i++) {
+		/* Handlers bound their replies with the size used so far */
+		size = repl_ndr->offset;
+		OC_DEBUG(5, "MAPI Rop: 0x%.2x (%d)\n", mapi_request->mapi_req[i].opnum, size);
+
+		if (stats || load) {
+			emsmdbp_stats_start(&start);
+		}
+		oc_trace_span_begin(&rop_span, "rop", mapi_request->mapi_req[i].opnum);
+		emsmdbp_change_numbers_begin(emsmdbp_ctx);
+
+		/* Past its hard limit, the session may only release objects */
+		if (memory_state == EMSMDBP_MEMORY_HARD && mapi_request->mapi_req[i].opnum != op_MAPI_Release) {
+			mapi_response->mapi_repl[idx].opnum = mapi_request->mapi_req[i].opnum;
+			mapi_response->mapi_repl[idx].handle_idx = mapi_request->mapi_req[i].handle_idx;
+			mapi_response->mapi_repl[idx].error_code = ecMemory;
+			retval = MAPI_E_SUCCESS;
+			goto rop_done;
+		}
+
+		/* Under load, bulk ROPs wait for the backends to catch up */
+		if (emsmdbp_sched_bulk_rop(&mapi_request->mapi_req[i])) {
+			emsmdbp_threads_set_bulk();
+		}
+		backoff = load ? emsmdbp_load_backoff(&mapi_request->mapi_req[i]) : 0;
+		if (backoff) {
+			EcDoRpc_backoff_rop(mem_ctx, &(mapi_request->mapi_req[i]),
+					    &(mapi_response->mapi_repl[idx]), backoff,
+					    &backoffs, &backoff_count);
+			retval = MAPI_E_SUCCESS;
+			goto rop_done;
 		}
 
 		switch (mapi_request->mapi_req[i].opnum) {
 		case op_MAPI_Release: /* 0x01 */
-			retval = EcDoRpc_RopRelease(mem_ctx, emsmdbp_ctx, 
+			retval = EcDoRpc_RopRelease(rop_ctx, emsmdbp_ctx, 
 						    &(mapi_request->mapi_req[i]),
 						    mapi_request->handles, &size);
 			break;
 		case op_MAPI_OpenFolder: /* 0x02 */
-			retval = EcDoRpc_RopOpenFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopOpenFolder(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 			break;
 		case op_MAPI_OpenMessage: /* 0x3 */
-			retval = EcDoRpc_RopOpenMessage(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopOpenMessage(rop_ctx, emsmdbp_ctx,
 							&(mapi_request->mapi_req[i]),
 							&(mapi_response->mapi_repl[idx]),
 							mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetHierarchyTable: /* 0x04 */
-			retval = EcDoRpc_RopGetHierarchyTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetHierarchyTable(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),
 							      mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetContentsTable: /* 0x05 */
-			retval = EcDoRpc_RopGetContentsTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetContentsTable(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		case op_MAPI_CreateMessage: /* 0x06 */
-			retval = EcDoRpc_RopCreateMessage(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopCreateMessage(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetProps: /* 0x07 */
-			retval = EcDoRpc_RopGetPropertiesSpecific(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPropertiesSpecific(rop_ctx, emsmdbp_ctx,
 								  &(mapi_request->mapi_req[i]),
 								  &(mapi_response->mapi_repl[idx]),
 								  mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetPropsAll: /* 0x8 */
-			retval = EcDoRpc_RopGetPropertiesAll(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPropertiesAll(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetPropList: /* 0x9 */
-			retval = EcDoRpc_RopGetPropertiesList(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPropertiesList(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),	
 							      mapi_response->handles, &size);
 			break;
 		case op_MAPI_SetProps: /* 0x0a */
-			retval = EcDoRpc_RopSetProperties(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetProperties(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_DeleteProps: /* 0xb */
-			retval = EcDoRpc_RopDeleteProperties(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopDeleteProperties(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		case op_MAPI_SaveChangesMessage: /* 0x0c */
-			retval = EcDoRpc_RopSaveChangesMessage(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSaveChangesMessage(rop_ctx, emsmdbp_ctx,
                                                                &(mapi_request->mapi_req[i]),
                                                                &(mapi_response->mapi_repl[idx]),
                                                                mapi_response->handles, &size);
 			break;
 		case op_MAPI_RemoveAllRecipients: /* 0xd */
-			retval = EcDoRpc_RopRemoveAllRecipients(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopRemoveAllRecipients(rop_ctx, emsmdbp_ctx,
 								&(mapi_request->mapi_req[i]),
 								&(mapi_response->mapi_repl[idx]),
 								mapi_response->handles, &size);
 			break;
 		case op_MAPI_ModifyRecipients: /* 0xe */
-			retval = EcDoRpc_RopModifyRecipients(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopModifyRecipients(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 
-		/* op_MAPI_ReadRecipients: 0xf */
+		case op_MAPI_ReadRecipients: /* 0xf */
+			retval = EcDoRpc_RopReadRecipients(rop_ctx, emsmdbp_ctx,
+							   &(mapi_request->mapi_req[i]),
+							   &(mapi_response->mapi_repl[idx]),
+							   mapi_response->handles, &size);
+			break;
 		case op_MAPI_ReloadCachedInformation: /* 0x10 */
-			retval = EcDoRpc_RopReloadCachedInformation(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopReloadCachedInformation(rop_ctx, emsmdbp_ctx,
 								    &(mapi_request->mapi_req[i]),
 								    &(mapi_response->mapi_repl[idx]),
 								    mapi_response->handles, &size);
 			break;
 		case op_MAPI_SetMessageReadFlag: /* 0x11 */
-			retval = EcDoRpc_RopSetMessageReadFlag(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetMessageReadFlag(rop_ctx, emsmdbp_ctx,
 							       &(mapi_request->mapi_req[i]),
 							       &(mapi_response->mapi_repl[idx]),
 							       mapi_response->handles, &size);
 			break;
 		case op_MAPI_SetColumns: /* 0x12 */
-			retval = EcDoRpc_RopSetColumns(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetColumns(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 			break;
 		case op_MAPI_SortTable: /* 0x13 */
-			retval = EcDoRpc_RopSortTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSortTable(rop_ctx, emsmdbp_ctx,
 						      &(mapi_request->mapi_req[i]),
 						      &(mapi_response->mapi_repl[idx]),
 						      mapi_response->handles, &size);
 			break;
 		case op_MAPI_Restrict: /* 0x14 */
-			retval = EcDoRpc_RopRestrict(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopRestrict(rop_ctx, emsmdbp_ctx,
 						     &(mapi_request->mapi_req[i]),
 						     &(mapi_response->mapi_repl[idx]),
 						     mapi_response->handles, &size);
 			break;
 		case op_MAPI_QueryRows: /* 0x15 */
-			retval = EcDoRpc_RopQueryRows(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopQueryRows(rop_ctx, emsmdbp_ctx,
 						      &(mapi_request->mapi_req[i]),
 						      &(mapi_response->mapi_repl[idx]),
 						      mapi_response->handles, &size);
 			break;
 		/* op_MAPI_GetStatus: 0x16 */
 		case op_MAPI_QueryPosition: /* 0x17 */
-			retval = EcDoRpc_RopQueryPosition(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopQueryPosition(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_SeekRow: /* 0x18 */
-			retval = EcDoRpc_RopSeekRow(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSeekRow(rop_ctx, emsmdbp_ctx,
 						    &(mapi_request->mapi_req[i]),
 						    &(mapi_response->mapi_repl[idx]),
 						    mapi_response->handles, &size);
 			break;
-		/* op_MAPI_SeekRowBookmark: 0x19 */
+		case op_MAPI_SeekRowBookmark: /* 0x19 */
+			retval = EcDoRpc_RopSeekRowBookmark(rop_ctx, emsmdbp_ctx,
+							    &(mapi_request->mapi_req[i]),
+							    &(mapi_response->mapi_repl[idx]),
+							    mapi_response->handles, &size);
+			break;
 		/* op_MAPI_SeekRowApprox: 0x1a */
-		/* op_MAPI_CreateBookmark: 0x1b */
+		case op_MAPI_CreateBookmark: /* 0x1b */
+			retval = EcDoRpc_RopCreateBookmark(rop_ctx, emsmdbp_ctx,
+							   &(mapi_request->mapi_req[i]),
+							   &(mapi_response->mapi_repl[idx]),
+							   mapi_response->handles, &size);
+			break;
 		case op_MAPI_CreateFolder: /* 0x1c */
-			retval = EcDoRpc_RopCreateFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopCreateFolder(rop_ctx, emsmdbp_ctx,
 							 &(mapi_request->mapi_req[i]),
 							 &(mapi_response->mapi_repl[idx]),
 							 mapi_response->handles, &size);
 			break;
 		case op_MAPI_DeleteFolder: /* 0x1d */
-			retval = EcDoRpc_RopDeleteFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopDeleteFolder(rop_ctx, emsmdbp_ctx,
 							 &(mapi_request->mapi_req[i]),
 							 &(mapi_response->mapi_repl[idx]),
 							 mapi_response->handles, &size);
 			break;
 		case op_MAPI_DeleteMessages: /* 0x1e */
-			retval = EcDoRpc_RopDeleteMessages(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopDeleteMessages(rop_ctx, emsmdbp_ctx,
 							   &(mapi_request->mapi_req[i]),
 							   &(mapi_response->mapi_repl[idx]),
 							   mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetMessageStatus: /* 0x1f */
-			retval = EcDoRpc_RopGetMessageStatus(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetMessageStatus(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		/* op_MAPI_SetMessageStatus: 0x20 */
 		case op_MAPI_GetAttachmentTable: /* 0x21 */
-			retval = EcDoRpc_RopGetAttachmentTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetAttachmentTable(rop_ctx, emsmdbp_ctx,
 							       &(mapi_request->mapi_req[i]),
 							       &(mapi_response->mapi_repl[idx]),
 							       mapi_response->handles, &size);
 			break;
                 case op_MAPI_OpenAttach: /* 0x22 */
-			retval = EcDoRpc_RopOpenAttach(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopOpenAttach(rop_ctx, emsmdbp_ctx,
                                                        &(mapi_request->mapi_req[i]),
                                                        &(mapi_response->mapi_repl[idx]),
                                                        mapi_response->handles, &size);
 			break;
                 case op_MAPI_CreateAttach: /* 0x23 */
-			retval = EcDoRpc_RopCreateAttach(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopCreateAttach(rop_ctx, emsmdbp_ctx,
                                                          &(mapi_request->mapi_req[i]),
                                                          &(mapi_response->mapi_repl[idx]),
                                                          mapi_response->handles, &size);
 			break;
 		/* op_MAPI_DeleteAttach: 0x24 */
 		case op_MAPI_SaveChangesAttachment: /* 0x25 */
-			retval = EcDoRpc_RopSaveChangesAttachment(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSaveChangesAttachment(rop_ctx, emsmdbp_ctx,
                                                                   &(mapi_request->mapi_req[i]),
                                                                   &(mapi_response->mapi_repl[idx]),
                                                                   mapi_response->handles, &size);
 			break;
 		case op_MAPI_SetReceiveFolder: /* 0x26 */
-			retval = EcDoRpc_RopSetReceiveFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetReceiveFolder(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetReceiveFolder: /* 0x27 */
-			retval = EcDoRpc_RopGetReceiveFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetReceiveFolder(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		case op_MAPI_RegisterNotification: /* 0x29 */
-			retval = EcDoRpc_RopRegisterNotification(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopRegisterNotification(rop_ctx, emsmdbp_ctx,
 								 &(mapi_request->mapi_req[i]),
 								 &(mapi_response->mapi_repl[idx]),
 								 mapi_response->handles, &size);
 			break;
 		/* op_MAPI_Notify: 0x2a */
 		case op_MAPI_OpenStream: /* 0x2b */
-			retval = EcDoRpc_RopOpenStream(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopOpenStream(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 			break;
 		case op_MAPI_ReadStream: /* 0x2c */
-			retval = EcDoRpc_RopReadStream(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopReadStream(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 			break;
 		case op_MAPI_WriteStream: /* 0x2d */
-			retval = EcDoRpc_RopWriteStream(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopWriteStream(rop_ctx, emsmdbp_ctx,
 							&(mapi_request->mapi_req[i]),
 							&(mapi_response->mapi_repl[idx]),
 							mapi_response->handles, &size);
 			break;
                 case op_MAPI_SeekStream: /* 0x2e */
-			retval = EcDoRpc_RopSeekStream(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSeekStream(rop_ctx, emsmdbp_ctx,
                                                        &(mapi_request->mapi_req[i]),
                                                        &(mapi_response->mapi_repl[idx]),
                                                        mapi_response->handles, &size);
 			break;
                 case op_MAPI_SetStreamSize: /* 0x2f */
-			retval = EcDoRpc_RopSetStreamSize(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetStreamSize(rop_ctx, emsmdbp_ctx,
                                                           &(mapi_request->mapi_req[i]),
                                                           &(mapi_response->mapi_repl[idx]),
                                                           mapi_response->handles, &size);
 			break;
 		case op_MAPI_SetSearchCriteria: /* 0x30 */
-			retval = EcDoRpc_RopSetSearchCriteria(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetSearchCriteria(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),
 							      mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetSearchCriteria: /* 0x31 */
-			retval = EcDoRpc_RopGetSearchCriteria(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetSearchCriteria(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),
 							      mapi_response->handles, &size);
 			break;
 		case op_MAPI_SubmitMessage: /* 0x32 */
-			retval = EcDoRpc_RopSubmitMessage(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSubmitMessage(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_MoveCopyMessages: /* 0x33 */
-			retval = EcDoRpc_RopMoveCopyMessages(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopMoveCopyMessages(rop_ctx, emsmdbp_ctx,
 							    &(mapi_request->mapi_req[i]),
 							    &(mapi_response->mapi_repl[idx]),
 							    mapi_response->handles, &size);
 		        break;
 		/* op_MAPI_AbortSubmit: 0x34 */
 		case op_MAPI_MoveFolder: /* 0x35 */
-			retval = EcDoRpc_RopMoveFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopMoveFolder(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 		        break;
 		case op_MAPI_CopyFolder: /* 0x36 */
-			retval = EcDoRpc_RopCopyFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopCopyFolder(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
@@ -595,7 +1079,7 @@ static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
 		/* op_MAPI_QueryColumnsAll: 0x37 */
 		/* op_MAPI_Abort: 0x38 */
 		case op_MAPI_CopyTo: /* 0x39 */
-                        retval = EcDoRpc_RopCopyTo(mem_ctx, emsmdbp_ctx,
+                        retval = EcDoRpc_RopCopyTo(rop_ctx, emsmdbp_ctx,
                                                    &(mapi_request->mapi_req[i]),
                                                    &(mapi_response->mapi_repl[idx]),
                                                    mapi_response->handles, &size);
@@ -603,64 +1087,64 @@ static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
 		/* op_MAPI_CopyToStream: 0x3a */
 		/* op_MAPI_CloneStream: 0x3b */
 		case op_MAPI_GetPermissionsTable: /* 0x3e */
-			retval = EcDoRpc_RopGetPermissionsTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPermissionsTable(rop_ctx, emsmdbp_ctx,
 								&(mapi_request->mapi_req[i]),
 								&(mapi_response->mapi_repl[idx]),
 								mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetRulesTable: /* 0x3f */
-			retval = EcDoRpc_RopGetRulesTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetRulesTable(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_ModifyPermissions: /* 0x40 */
-			retval = EcDoRpc_RopModifyPermissions(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopModifyPermissions(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),
 							      mapi_response->handles, &size);
 			break;
 		case op_MAPI_ModifyRules: /* 0x41 */
-			retval = EcDoRpc_RopModifyRules(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopModifyRules(rop_ctx, emsmdbp_ctx,
 							&(mapi_request->mapi_req[i]),
 							&(mapi_response->mapi_repl[idx]),
 							mapi_response->handles, &size);
 			break;
 		/* op_MAPI_GetOwningServers: 0x42 */
 		case op_MAPI_LongTermIdFromId: /* 0x43 */
-			retval = EcDoRpc_RopLongTermIdFromId(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopLongTermIdFromId(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		case op_MAPI_IdFromLongTermId: /* 0x44 */
-			retval = EcDoRpc_RopIdFromLongTermId(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopIdFromLongTermId(rop_ctx, emsmdbp_ctx,
 							     &(mapi_request->mapi_req[i]),
 							     &(mapi_response->mapi_repl[idx]),
 							     mapi_response->handles, &size);
 			break;
 		/* op_MAPI_PublicFolderIsGhosted: 0x45 */
 		case op_MAPI_OpenEmbeddedMessage: /* 0x46 */
-			retval = EcDoRpc_RopOpenEmbeddedMessage(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopOpenEmbeddedMessage(rop_ctx, emsmdbp_ctx,
                                                                 &(mapi_request->mapi_req[i]),
                                                                 &(mapi_response->mapi_repl[idx]),
                                                                 mapi_response->handles, &size);
                         break;
 		case op_MAPI_SetSpooler: /* 0x47 */
-			retval = EcDoRpc_RopSetSpooler(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetSpooler(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 			break;
 		/* op_MAPI_SpoolerLockMessage: 0x48 */
 		case op_MAPI_AddressTypes: /*x49 */
-			retval = EcDoRpc_RopGetAddressTypes(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetAddressTypes(rop_ctx, emsmdbp_ctx,
 							    &(mapi_request->mapi_req[i]),
 							    &(mapi_response->mapi_repl[idx]),
 							    mapi_response->handles, &size);
 			break;
 		case op_MAPI_TransportSend: /* 0x4a */
-			retval = EcDoRpc_RopTransportSend(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopTransportSend(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
@@ -668,19 +1152,19 @@ static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
 		/* op_MAPI_FastTransferSourceCopyMessages: 0x4b */
 		/* op_MAPI_FastTransferSourceCopyFolder: 0x4c */
 		case op_MAPI_FastTransferSourceCopyTo: /* 0x4d */
-			retval = EcDoRpc_RopFastTransferSourceCopyTo(mem_ctx, emsmdbp_ctx, 
+			retval = EcDoRpc_RopFastTransferSourceCopyTo(rop_ctx, emsmdbp_ctx, 
 								     &(mapi_request->mapi_req[i]),
 								     &(mapi_response->mapi_repl[idx]),
 								     mapi_response->handles, &size);
 			break;
 		case op_MAPI_FastTransferSourceGetBuffer: /* 0x4e */
-			retval = EcDoRpc_RopFastTransferSourceGetBuffer(mem_ctx, emsmdbp_ctx, 
+			retval = EcDoRpc_RopFastTransferSourceGetBuffer(rop_ctx, emsmdbp_ctx, 
 									&(mapi_request->mapi_req[i]),
 									&(mapi_response->mapi_repl[idx]),
 									mapi_response->handles, &size);
 			break;
 		case op_MAPI_FindRow: /* 0x4f */
-			retval = EcDoRpc_RopFindRow(mem_ctx, emsmdbp_ctx, 
+			retval = EcDoRpc_RopFindRow(rop_ctx, emsmdbp_ctx, 
 						    &(mapi_request->mapi_req[i]),
 						    &(mapi_response->mapi_repl[idx]),
 						    mapi_response->handles, &size);
@@ -689,189 +1173,219 @@ static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
 		/* op_MAPI_TransportNewMail: 0x51 */
 		/* op_MAPI_GetValidAttachments: 0x52 */
 		case op_MAPI_GetNamesFromIDs: /* 0x55 */
-			retval = EcDoRpc_RopGetNamesFromIDs(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetNamesFromIDs(rop_ctx, emsmdbp_ctx,
 							    &(mapi_request->mapi_req[i]),
 							    &(mapi_response->mapi_repl[idx]),
 							    mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetIDsFromNames: /* 0x56 */
-			retval = EcDoRpc_RopGetPropertyIdsFromNames(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPropertyIdsFromNames(rop_ctx, emsmdbp_ctx,
 								    &(mapi_request->mapi_req[i]),
 								    &(mapi_response->mapi_repl[idx]),
 								    mapi_response->handles, &size);
 			break;
 		/* op_MAPI_UpdateDeferredActionMessages: 0x57 */ 
 		case op_MAPI_EmptyFolder: /* 0x58 */
-		retval = EcDoRpc_RopEmptyFolder(mem_ctx, emsmdbp_ctx,
+		retval = EcDoRpc_RopEmptyFolder(rop_ctx, emsmdbp_ctx,
 						&(mapi_request->mapi_req[i]),
 						&(mapi_response->mapi_repl[idx]),
 						mapi_response->handles, &size);
 			break;
-		/* op_MAPI_ExpandRow: 0x59 */
-		/* op_MAPI_CollapseRow: 0x5a */
+		case op_MAPI_ExpandRow: /* 0x59 */
+			retval = EcDoRpc_RopExpandRow(rop_ctx, emsmdbp_ctx,
+						      &(mapi_request->mapi_req[i]),
+						      &(mapi_response->mapi_repl[idx]),
+						      mapi_response->handles, &size);
+			break;
+		case op_MAPI_CollapseRow: /* 0x5a */
+			retval = EcDoRpc_RopCollapseRow(rop_ctx, emsmdbp_ctx,
+							&(mapi_request->mapi_req[i]),
+							&(mapi_response->mapi_repl[idx]),
+							mapi_response->handles, &size);
+			break;
 		/* op_MAPI_LockRegionStream: 0x5b */
 		/* op_MAPI_UnlockRegionStream: 0x5c */
 		case op_MAPI_CommitStream: /* 0x5d */
-			retval = EcDoRpc_RopCommitStream(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopCommitStream(rop_ctx, emsmdbp_ctx,
 							 &(mapi_request->mapi_req[i]),
 							 &(mapi_response->mapi_repl[idx]),
 							 mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetStreamSize: /* 0x5e */
-			retval = EcDoRpc_RopGetStreamSize(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetStreamSize(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		/* op_MAPI_QueryNamedProperties: 0x5f */
 		case op_MAPI_GetPerUserLongTermIds: /* 0x60 */
-			retval = EcDoRpc_RopGetPerUserLongTermIds(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPerUserLongTermIds(rop_ctx, emsmdbp_ctx,
 								  &(mapi_request->mapi_req[i]),
 								  &(mapi_response->mapi_repl[idx]),
 								  mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetPerUserGuid: /* 0x61 */
-			retval = EcDoRpc_RopGetPerUserGuid(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetPerUserGuid(rop_ctx, emsmdbp_ctx,
 							   &(mapi_request->mapi_req[i]),
 							   &(mapi_response->mapi_repl[idx]),
 							   mapi_response->handles, &size);
 			break;
 		case op_MAPI_ReadPerUserInformation: /* 0x63 */
-			retval = EcDoRpc_RopReadPerUserInformation(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopReadPerUserInformation(rop_ctx, emsmdbp_ctx,
 								   &(mapi_request->mapi_req[i]),
 								   &(mapi_response->mapi_repl[idx]),
 								   mapi_response->handles, &size);
 			break;
 		/* op_MAPI_ReadPerUserInformation: 0x63 */
-		/* op_MAPI_SetReadFlags: 0x66 */
+		case op_MAPI_SetReadFlags: /* 0x66 */
+			retval = EcDoRpc_RopSetReadFlags(rop_ctx, emsmdbp_ctx,
+							 &(mapi_request->mapi_req[i]),
+							 &(mapi_response->mapi_repl[idx]),
+							 mapi_response->handles, &size);
+			break;
 		/* op_MAPI_CopyProperties: 0x67 */
 		case op_MAPI_GetReceiveFolderTable: /* 0x68 */
-			retval = EcDoRpc_RopGetReceiveFolderTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetReceiveFolderTable(rop_ctx, emsmdbp_ctx,
 								  &(mapi_request->mapi_req[i]),
 								  &(mapi_response->mapi_repl[idx]),
 								  mapi_response->handles, &size);
 			break;
 
-		/* op_MAPI_GetCollapseState: 0x6b */
-		/* op_MAPI_SetCollapseState: 0x6c */
+		case op_MAPI_GetCollapseState: /* 0x6b */
+			retval = EcDoRpc_RopGetCollapseState(rop_ctx, emsmdbp_ctx,
+							     &(mapi_request->mapi_req[i]),
+							     &(mapi_response->mapi_repl[idx]),
+							     mapi_response->handles, &size);
+			break;
+		case op_MAPI_SetCollapseState: /* 0x6c */
+			retval = EcDoRpc_RopSetCollapseState(rop_ctx, emsmdbp_ctx,
+							     &(mapi_request->mapi_req[i]),
+							     &(mapi_response->mapi_repl[idx]),
+							     mapi_response->handles, &size);
+			break;
 		case op_MAPI_GetTransportFolder: /* 0x6d */
-			retval = EcDoRpc_RopGetTransportFolder(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetTransportFolder(rop_ctx, emsmdbp_ctx,
 							       &(mapi_request->mapi_req[i]),
 							       &(mapi_response->mapi_repl[idx]),
 							       mapi_response->handles, &size);
 			break;
 		/* op_MAPI_Pending: 0x6e */
 		case op_MAPI_OptionsData: /* 0x6f */
-			retval = EcDoRpc_RopOptionsData(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopOptionsData(rop_ctx, emsmdbp_ctx,
 							&(mapi_request->mapi_req[i]),
 							&(mapi_response->mapi_repl[idx]),
 							mapi_response->handles, &size);
 			break;
                 case op_MAPI_SyncConfigure: /* 0x70 */
-			retval = EcDoRpc_RopSyncConfigure(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncConfigure(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncImportMessageChange: /* 0x72 */
-			retval = EcDoRpc_RopSyncImportMessageChange(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncImportMessageChange(rop_ctx, emsmdbp_ctx,
 								    &(mapi_request->mapi_req[i]),
 								    &(mapi_response->mapi_repl[idx]),
 								    mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncImportHierarchyChange: /* 0x73 */
-			retval = EcDoRpc_RopSyncImportHierarchyChange(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncImportHierarchyChange(rop_ctx, emsmdbp_ctx,
 								      &(mapi_request->mapi_req[i]),
 								      &(mapi_response->mapi_repl[idx]),
 								      mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncImportDeletes: /* 0x74 */
-			retval = EcDoRpc_RopSyncImportDeletes(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncImportDeletes(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),
 							      mapi_response->handles, &size);
 			break;
                 case op_MAPI_SyncUploadStateStreamBegin: /* 0x75 */
-			retval = EcDoRpc_RopSyncUploadStateStreamBegin(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncUploadStateStreamBegin(rop_ctx, emsmdbp_ctx,
 								       &(mapi_request->mapi_req[i]),
 								       &(mapi_response->mapi_repl[idx]),
 								       mapi_response->handles, &size);
 			break;
                 case op_MAPI_SyncUploadStateStreamContinue: /* 0x76 */
-			retval = EcDoRpc_RopSyncUploadStateStreamContinue(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncUploadStateStreamContinue(rop_ctx, emsmdbp_ctx,
 									  &(mapi_request->mapi_req[i]),
 									  &(mapi_response->mapi_repl[idx]),
 									  mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncUploadStateStreamEnd: /* 0x77 */
-			retval = EcDoRpc_RopSyncUploadStateStreamEnd(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncUploadStateStreamEnd(rop_ctx, emsmdbp_ctx,
 								     &(mapi_request->mapi_req[i]),
 								     &(mapi_response->mapi_repl[idx]),
 								     mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncImportMessageMove: /* 0x78 */
-			retval = EcDoRpc_RopSyncImportMessageMove(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncImportMessageMove(rop_ctx, emsmdbp_ctx,
 								  &(mapi_request->mapi_req[i]),
 								  &(mapi_response->mapi_repl[idx]),
 								  mapi_response->handles, &size);
 			break;
 		/* op_MAPI_SetPropertiesNoReplicate: 0x79 */
 		case op_MAPI_DeletePropertiesNoReplicate: /* 0x7a */
-			retval = EcDoRpc_RopDeletePropertiesNoReplicate(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopDeletePropertiesNoReplicate(rop_ctx, emsmdbp_ctx,
 									&(mapi_request->mapi_req[i]),
 									&(mapi_response->mapi_repl[idx]),
 									mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetStoreState: /* 0x7b */
-			retval = EcDoRpc_RopGetStoreState(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetStoreState(rop_ctx, emsmdbp_ctx,
 							  &(mapi_request->mapi_req[i]),
 							  &(mapi_response->mapi_repl[idx]),
 							  mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncOpenCollector: /* 0x7e */
-			retval = EcDoRpc_RopSyncOpenCollector(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncOpenCollector(rop_ctx, emsmdbp_ctx,
 							      &(mapi_request->mapi_req[i]),
 							      &(mapi_response->mapi_repl[idx]),
 							      mapi_response->handles, &size);
 			break;
 		case op_MAPI_GetLocalReplicaIds: /* 0x7f */
-			retval = EcDoRpc_RopGetLocalReplicaIds(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopGetLocalReplicaIds(rop_ctx, emsmdbp_ctx,
                                                                &(mapi_request->mapi_req[i]),
                                                                &(mapi_response->mapi_repl[idx]),
                                                                mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncImportReadStateChanges: /* 0x80 */
-			retval = EcDoRpc_RopSyncImportReadStateChanges(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncImportReadStateChanges(rop_ctx, emsmdbp_ctx,
 								       &(mapi_request->mapi_req[i]),
 								       &(mapi_response->mapi_repl[idx]),
 								       mapi_response->handles, &size);
 			break;
 		case op_MAPI_ResetTable: /* 0x81 */
-			retval = EcDoRpc_RopResetTable(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopResetTable(rop_ctx, emsmdbp_ctx,
 						       &(mapi_request->mapi_req[i]),
 						       &(mapi_response->mapi_repl[idx]),
 						       mapi_response->handles, &size);
 			break;
 		case op_MAPI_SyncGetTransferState: /* 0x82 */
-			retval = EcDoRpc_RopSyncGetTransferState(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSyncGetTransferState(rop_ctx, emsmdbp_ctx,
 								 &(mapi_request->mapi_req[i]),
 								 &(mapi_response->mapi_repl[idx]),
 								 mapi_response->handles, &size);
 			break;
 		/* op_MAPI_OpenPublicFolderByName: 0x87 */
 		/* op_MAPI_SetSyncNotificationGuid: 0x88 */
-		/* op_MAPI_FreeBookmark: 0x89 */
+		case op_MAPI_FreeBookmark: /* 0x89 */
+			retval = EcDoRpc_RopFreeBookmark(rop_ctx, emsmdbp_ctx,
+							 &(mapi_request->mapi_req[i]),
+							 &(mapi_response->mapi_repl[idx]),
+							 mapi_response->handles, &size);
+			break;
 		/* op_MAPI_WriteAndCommitStream: 0x90 */
 		/* op_MAPI_HardDeleteMessages: 0x91 */
 		/* op_MAPI_HardDeleteMessagesAndSubfolders: 0x92 */
 		case op_MAPI_SetLocalReplicaMidsetDeleted: /* 0x93 */
-			retval = EcDoRpc_RopSetLocalReplicaMidsetDeleted(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopSetLocalReplicaMidsetDeleted(rop_ctx, emsmdbp_ctx,
 									 &(mapi_request->mapi_req[i]),
 									 &(mapi_response->mapi_repl[idx]),
 									 mapi_response->handles, &size);
 			break;
 		case op_MAPI_Logon: /* 0xfe */
-			retval = EcDoRpc_RopLogon(mem_ctx, emsmdbp_ctx,
+			retval = EcDoRpc_RopLogon(rop_ctx, emsmdbp_ctx,
 						  &(mapi_request->mapi_req[i]),
 						  &(mapi_response->mapi_repl[idx]),
 						  mapi_response->handles, &size);
@@ -881,32 +1395,80 @@ static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
 				  mapi_request->mapi_req[i].opnum);
 		}
 
+		if (load) {
+			emsmdbp_load_rop(&start);
+		}
+
+	rop_done:
+		emsmdbp_change_numbers_end(emsmdbp_ctx);
+		oc_trace_span_end(&rop_span, retval);
+
+		if (stats) {
+			failed = (retval != MAPI_E_SUCCESS);
+			if (mapi_request->mapi_req[i].opnum != op_MAPI_Release &&
+			    mapi_response->mapi_repl[idx].error_code != MAPI_E_SUCCESS) {
+				failed = true;
+			}
+			emsmdbp_stats_rop(mapi_request->mapi_req[i].opnum, failed, &start);
+		}
+
 		if (mapi_request->mapi_req[i].opnum != op_MAPI_Release) {
+			EcDoRpc_push_reply(repl_ndr, &(mapi_response->mapi_repl[idx]));
 			idx++;
 		}
 
+		if (!EcDoRpc_rop_preserves_tables(mapi_request->mapi_req[i].opnum)) {
+			emsmdbp_ctx->table_generation++;
+		}
+
 		if (retval) {
 			OC_DEBUG(5, "MAPI Rop: 0x%.2x [retval=0x%.8x]\n", mapi_request->mapi_req[i].opnum, retval);
 		}
 	}
 
+	if (rop_ctx != mem_ctx) {
+		EcDoRpc_rop_pool_update(rop_ctx);
+	}
+
+	/* Tell the client when to send the delayed ROPs again */
+	for (i = 0; i < backoff_count; i++) {
+		mapi_repl = talloc_realloc(mem_ctx, mapi_response->mapi_repl, struct EcDoRpc_MAPI_REPL, idx + 2);
+		if (!mapi_repl) {
+			OC_DEBUG(0, "No memory available");
+			break;
+		}
+		mapi_response->mapi_repl = mapi_repl;
+		memset(&mapi_repl[idx], 0, sizeof (struct EcDoRpc_MAPI_REPL));
+		mapi_repl[idx].opnum = op_MAPI_Backoff;
+		mapi_repl[idx].u.mapi_Backoff = backoffs[i];
+		EcDoRpc_push_reply(repl_ndr, &mapi_repl[idx]);
+		idx++;
+	}
+
 notif:
 	/* Step 3. Notifications/Pending calls should be processed here */
 	/* Note: GetProps and GetRows are filled with flag NDR_REMAINING, which may hide the content of the following replies. */
-	{
+	if (notifications) {
 		DATA_BLOB		payload;
 		enum mapistore_error	ret;
 		struct ndr_pull		*ndr;
 		enum ndr_err_code	ndr_err_code;
+		uint32_t		first;
+		uint32_t		count;
+		int			threshold;
 
-		ret = mapistore_notification_deliver_get(mem_ctx, emsmdbp_ctx->mstore_ctx, emsmdbp_ctx->session_uuid,
-							 &payload.data, &payload.length);
+		ret = EcDoRpc_fetch_notifications(mem_ctx, emsmdbp_ctx, &payload);
 		if (ret == MAPISTORE_SUCCESS) {
+			/* TableModified and object notifications mean that
+			   rows cached for this session may be stale */
+			emsmdbp_ctx->table_generation++;
+
 			ndr = ndr_pull_init_blob(&payload, mem_ctx);
 			if (!ndr) {
 				OC_DEBUG(0, "Unable to initialize notification ndr pull blob");
 				goto end;
 			}
+			first = idx;
 			while (ndr->offset != payload.length) {
 				if (mapi_response->mapi_repl) {
 					mapi_response->mapi_repl = talloc_realloc(mem_ctx, mapi_response->mapi_repl,
@@ -923,14 +1485,30 @@ notif:
 					OC_DEBUG(0, "Unable to add notification blob");
 					break;
 				}
-				size += libmapiserver_RopNotify_size(&(mapi_response->mapi_repl[idx]));
 				idx++;
 			}
 
-			ret = mapistore_notification_deliver_delete(emsmdbp_ctx->mstore_ctx, emsmdbp_ctx->session_uuid);
-			if (ret != MAPISTORE_SUCCESS) {
-				OC_DEBUG(0, "Unable to delete notification key");
+			/* Search folders, the folder cache and the message
+			   counters follow the changes made by others */
+			for (i = first; i < idx; i++) {
+				if (mapi_response->mapi_repl[i].opnum == op_MAPI_Notify) {
+					emsmdbp_search_notify(emsmdbp_ctx, &mapi_response->mapi_repl[i].u.mapi_Notify);
+					emsmdbp_folder_cache_notify(emsmdbp_ctx, &mapi_response->mapi_repl[i].u.mapi_Notify);
+					emsmdbp_message_counts_notify(emsmdbp_ctx, &mapi_response->mapi_repl[i].u.mapi_Notify);
+				}
+			}
+
+			/* Merge table events accumulated since the last call */
+			threshold = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "table_changed_threshold", 32);
+			count = libmapiserver_RopNotify_coalesce(&(mapi_response->mapi_repl[first]), idx - first,
+								 (threshold > 0) ? threshold : 0);
+			if (count != idx - first) {
+				OC_DEBUG(5, "%d notifications coalesced into %d", idx - first, count);
+			}
+			for (idx = first; idx < first + count; idx++) {
+				EcDoRpc_push_reply(repl_ndr, &(mapi_response->mapi_repl[idx]));
 			}
+			mapiproxy_stats_add(MAPIPROXY_STATS_EMSMDB_NOTIFICATIONS, count);
 			talloc_free(ndr);
 		}
 	}
@@ -940,14 +1518,109 @@ end:
 		mapi_response->mapi_repl[idx].opnum = 0;
 	}
 	
-	/* Step 4. Fill mapi_response structure */
+	/* Step 4. Fill mapi_response structure from the marshalled
+	   replies */
+	size = 0;
+	if (repl_ndr) {
+		size = repl_ndr->offset;
+		mapi_response->repl_data.data = repl_ndr->data;
+		mapi_response->repl_data.length = repl_ndr->offset;
+	}
 	handles_length = mapi_request->mapi_len - mapi_request->length;
 	mapi_response->length = size + sizeof (mapi_response->length);
 	mapi_response->mapi_len = mapi_response->length + handles_length;
 
+	oc_trace_span_end(&transaction_span, 0);
+
+	if (load) {
+		emsmdbp_load_end();
+	}
+
 	return mapi_response;
 }
 
+static struct mapi_response *EcDoRpc_process_transaction(TALLOC_CTX *mem_ctx,
+							 struct emsmdbp_context *emsmdbp_ctx,
+							 struct mapi_request *mapi_request)
+{
+	emsmdbp_sched_begin(emsmdbp_ctx);
+
+	return EcDoRpc_process_request(mem_ctx, emsmdbp_ctx, mapi_request, true);
+}
+
+
+/**
+   \details Check whether the last ROP of a request can be processed
+   again to fill a chained extended buffer
+
+   Only FastTransferSourceGetBuffer and ReadStream are repeated: their
+   response size is bounded by the request, so the remaining space of
+   rgbOut can be checked before consuming more of the stream.
+
+   \param mapi_request pointer to the processed request
+   \param mapi_response pointer to the response of the last pass
+   \param bound pointer to the maximum payload size of another pass
+
+   \return true if the ROP has more data to return, otherwise false
+ */
+static bool EcDoRpc_chainable_request(struct mapi_request *mapi_request,
+				      struct mapi_response *mapi_response,
+				      uint32_t *bound)
+{
+	struct EcDoRpc_MAPI_REQ		*mapi_req = NULL;
+	struct EcDoRpc_MAPI_REPL	*mapi_repl = NULL;
+	uint32_t			requested;
+	uint32_t			i;
+
+	if (mapi_request->mapi_len <= 2 || !mapi_request->mapi_req || !mapi_response->mapi_repl) {
+		return false;
+	}
+
+	for (i = 0; mapi_request->mapi_req[i].opnum != 0; i++) {
+		mapi_req = &mapi_request->mapi_req[i];
+	}
+	if (!mapi_req) return false;
+
+	/* Notifications may follow the reply of the ROP */
+	for (i = 0; mapi_response->mapi_repl[i].opnum != 0; i++) {
+		if (mapi_response->mapi_repl[i].opnum == mapi_req->opnum) {
+			mapi_repl = &mapi_response->mapi_repl[i];
+		}
+	}
+	if (!mapi_repl || mapi_repl->error_code != MAPI_E_SUCCESS) {
+		return false;
+	}
+
+	switch (mapi_req->opnum) {
+	case op_MAPI_FastTransferSourceGetBuffer:
+		if (mapi_repl->u.mapi_FastTransferSourceGetBuffer.TransferStatus != TransferStatus_Partial) {
+			return false;
+		}
+		requested = mapi_req->u.mapi_FastTransferSourceGetBuffer.BufferSize;
+		if (requested == 0xBABE) {
+			requested = mapi_req->u.mapi_FastTransferSourceGetBuffer.MaximumBufferSize.MaximumBufferSize;
+		}
+		break;
+	case op_MAPI_ReadStream:
+		requested = mapi_req->u.mapi_ReadStream.ByteCount;
+		if (requested == 0xBABE) {
+			requested = MIN(mapi_req->u.mapi_ReadStream.MaximumByteCount.value, 0xFFF0);
+		}
+		/* A short read means the end of the stream was reached */
+		if (!requested || mapi_repl->u.mapi_ReadStream.data.length < requested) {
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+
+	*bound = sizeof (uint16_t) + EMSMDB_CHAIN_ROP_OVERHEAD + requested +
+		(mapi_request->mapi_len - mapi_request->length);
+
+	return true;
+}
+
 /**
    \details exchange_emsmdb EcDoRpc (0x2) function
 
@@ -1175,6 +1848,124 @@ static bool clientVersionIsTooLow(const uint16_t rgwClientVersion[3])
 	}
 }
 
+/**
+   \details Log a user on: initialize its emsmdbp context and check it
+   belongs to the Exchange organization
+
+   \param mem_ctx pointer to the memory context
+   \param lp_ctx pointer to the loadparm context
+   \param username the account name of the authenticated user
+   \param szUserDN the legacyExchangeDN of the mailbox to log on
+   \param ulLcidString the locale of the client
+   \param emsmdbp_ctxp pointer on pointer to the emsmdbp context to return
+   \param szDNPrefix pointer to the DN prefix of the server to return
+   \param szDisplayName pointer to the display name of the user to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS EcDoConnectEx_logon(TALLOC_CTX *mem_ctx,
+					   struct loadparm_context *lp_ctx,
+					   const char *username,
+					   const char *szUserDN,
+					   uint32_t ulLcidString,
+					   struct emsmdbp_context **emsmdbp_ctxp,
+					   const char **szDNPrefix,
+					   const char **szDisplayName)
+{
+	struct emsmdbp_context		*emsmdbp_ctx;
+	struct ldb_message		*msg;
+	const char			*mailNickname;
+	const char			*userDN;
+	char				*dnprefix;
+
+	/* Step 1. Initialize the emsmdbp context */
+	emsmdbp_ctx = emsmdbp_init(lp_ctx, username, openchange_db_ctx);
+	if (!emsmdbp_ctx) {
+		OC_DEBUG(0, "FATAL: unable to initialize emsmdbp context");
+		return MAPI_E_LOGON_FAILED;
+	}
+
+	/* Step 2. Check if incoming user belongs to the Exchange organization */
+	if (emsmdbp_verify_username(emsmdbp_ctx, username) == false) {
+		talloc_free(emsmdbp_ctx);
+		return ecUnknownUser;
+	}
+
+	/* Step 3. Check if input user DN belongs to the Exchange organization */
+	if (emsmdbp_verify_userdn(NULL, emsmdbp_ctx, szUserDN, &msg) == false) {
+		talloc_free(emsmdbp_ctx);
+		return ecUnknownUser;
+	}
+
+	emsmdbp_ctx->szUserDN = talloc_strdup(emsmdbp_ctx, szUserDN);
+	emsmdbp_ctx->userLanguage = ulLcidString;
+
+	/* Step 4. Retrieve the display name of the user */
+	*szDisplayName = ldb_msg_find_attr_as_string(msg, "displayName", NULL);
+	emsmdbp_ctx->szDisplayName = talloc_strdup(emsmdbp_ctx, *szDisplayName);
+
+	/* Step 5. Retrieve the distinguished name of the server */
+	mailNickname = ldb_msg_find_attr_as_string(msg, "mailNickname", NULL);
+	userDN = ldb_msg_find_attr_as_string(msg, "legacyExchangeDN", NULL);
+	dnprefix = strstr(userDN, mailNickname);
+	if (!dnprefix) {
+		talloc_free(emsmdbp_ctx);
+		return MAPI_E_LOGON_FAILED;
+	}
+
+	*dnprefix = '\0';
+	emsmdbp_ctx->szDNPrefix = talloc_strdup(emsmdbp_ctx, userDN);
+	OPENCHANGE_RETVAL_IF(emsmdbp_ctx->szDNPrefix == NULL, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
+	*szDNPrefix = strupper_talloc(mem_ctx, userDN);
+	OPENCHANGE_RETVAL_IF(*szDNPrefix == NULL, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
+
+	*emsmdbp_ctxp = emsmdbp_ctx;
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Register the session of a newly logged on emsmdbp context
+
+   \param emsmdbp_ctx pointer to the emsmdbp context
+   \param uuid the session UUID
+   \param server_id the server identifier of the connection
+   \param context_id the context identifier of the connection
+   \param pullTimeStamp the logon time
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS EcDoConnectEx_register(struct emsmdbp_context *emsmdbp_ctx,
+					      struct GUID uuid,
+					      struct server_id server_id,
+					      uint32_t context_id,
+					      uint32_t pullTimeStamp)
+{
+	struct exchange_emsmdb_session	*session;
+
+	session = talloc_zero(emsmdb_session, struct exchange_emsmdb_session);
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
+
+	session->pullTimeStamp = pullTimeStamp;
+	session->session = mpm_session_new(session, server_id, context_id);
+	OPENCHANGE_RETVAL_IF(!session->session, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
+
+	session->uuid = uuid;
+
+	mpm_session_set_private_data(session->session, (void *) emsmdbp_ctx);
+	mpm_session_set_destructor(session->session, emsmdbp_destructor);
+
+	if (dcesrv_add_emsmdb_session(session) == false) {
+		OC_DEBUG(0, "[exchange_emsmdb]: Unable to register session %d\n", session->session->context_id);
+		talloc_free(session);
+		return MAPI_E_NOT_ENOUGH_RESOURCES;
+	}
+	OC_DEBUG(0, "[exchange_emsmdb]: New session added: %d (%"PRIu32" live)\n",
+		 session->session->context_id, emsmdb_session_count);
+
+	return MAPI_E_SUCCESS;
+}
+
 /**
    \details exchange_emsmdb EcDoConnectEx (0xA) function
 
@@ -1192,10 +1983,6 @@ static enum MAPISTATUS dcesrv_EcDoConnectEx(struct dcesrv_call_state *dce_call,
 	struct dcesrv_handle		*handle;
 	struct policy_handle		wire_handle;
 	struct exchange_emsmdb_session	*session;
-	struct ldb_message		*msg;
-	const char			*mailNickname;
-	const char			*userDN;
-	char				*dnprefix;
 	char				*tmp = "";
 
 	OC_DEBUG(3, "exchange_emsmdb: EcDoConnectEx (0xA)\n");
@@ -1242,52 +2029,15 @@ static enum MAPISTATUS dcesrv_EcDoConnectEx(struct dcesrv_call_state *dce_call,
 		goto failure;
 	}
 
-	/* Step 1. Initialize the emsmdbp context */
-	emsmdbp_ctx = emsmdbp_init(dce_call->conn->dce_ctx->lp_ctx,
-				   dcesrv_call_account_name(dce_call),
-				   openchange_db_ctx);
-	if (!emsmdbp_ctx) {
-		OC_DEBUG(0, "FATAL: unable to initialize emsmdbp context");
-		r->out.result = MAPI_E_LOGON_FAILED;
-		goto failure;
-	}
-
-	/* Step 2. Check if incoming user belongs to the Exchange organization */
-	if (emsmdbp_verify_user(dce_call, emsmdbp_ctx) == false) {
-		talloc_free(emsmdbp_ctx);
-		r->out.result = ecUnknownUser;
+	/* Step 1 to 5. Log the user on */
+	r->out.result = EcDoConnectEx_logon(mem_ctx, dce_call->conn->dce_ctx->lp_ctx,
+					     dcesrv_call_account_name(dce_call), r->in.szUserDN,
+					     r->in.ulLcidString, &emsmdbp_ctx, r->out.szDNPrefix,
+					     r->out.szDisplayName);
+	if (r->out.result != MAPI_E_SUCCESS) {
 		goto failure;
 	}
-
-	/* Step 3. Check if input user DN belongs to the Exchange organization */
-	if (emsmdbp_verify_userdn(dce_call, emsmdbp_ctx, r->in.szUserDN, &msg) == false) {
-		talloc_free(emsmdbp_ctx);
-		r->out.result = ecUnknownUser;
-		goto failure;
-	}
-
-	emsmdbp_ctx->szUserDN = talloc_strdup(emsmdbp_ctx, r->in.szUserDN);
-	emsmdbp_ctx->userLanguage = r->in.ulLcidString;
-
-	/* Step 4. Retrieve the display name of the user */
-	*r->out.szDisplayName = ldb_msg_find_attr_as_string(msg, "displayName", NULL);
-	emsmdbp_ctx->szDisplayName = talloc_strdup(emsmdbp_ctx, *r->out.szDisplayName);
-
-	/* Step 5. Retrieve the distinguished name of the server */
-	mailNickname = ldb_msg_find_attr_as_string(msg, "mailNickname", NULL);
-	userDN = ldb_msg_find_attr_as_string(msg, "legacyExchangeDN", NULL);
-	dnprefix = strstr(userDN, mailNickname);
-	if (!dnprefix) {
-		talloc_free(emsmdbp_ctx);
-		r->out.result = MAPI_E_LOGON_FAILED;
-		goto failure;
-	}
-
-	*dnprefix = '\0';
-	emsmdbp_ctx->szDNPrefix = talloc_strdup(emsmdbp_ctx, userDN);
-	OPENCHANGE_RETVAL_IF(emsmdbp_ctx->szDNPrefix == NULL, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
-	*r->out.szDNPrefix = strupper_talloc(mem_ctx, userDN);
-	OPENCHANGE_RETVAL_IF(*r->out.szDNPrefix == NULL, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
+	emsmdbp_ctx->ev_ctx = dce_call->event_ctx;
 
 	/* Step 6. Fill EcDoConnectEx reply */
 	handle = dcesrv_handle_new(dce_call->context, EXCHANGE_HANDLE_EMSMDB);
@@ -1345,23 +2095,164 @@ static enum MAPISTATUS dcesrv_EcDoConnectEx(struct dcesrv_call_state *dce_call,
 	}
 	else {
 		/* Step 7. Associate this emsmdbp context to the session */
-		session = talloc_zero(emsmdb_session, struct exchange_emsmdb_session);
-		OPENCHANGE_RETVAL_IF(!session, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
+		return EcDoConnectEx_register(emsmdbp_ctx, handle->wire_handle.uuid,
+					      dce_call->conn->server_id, dce_call->context->context_id,
+					      *r->out.pulTimeStamp);
+	}
 
-		session->pullTimeStamp = *r->out.pulTimeStamp;
-		session->session = mpm_session_init(session, dce_call);
-		OPENCHANGE_RETVAL_IF(!session->session, MAPI_E_NOT_ENOUGH_RESOURCES, emsmdbp_ctx);
-		
-		session->uuid = handle->wire_handle.uuid;
+	return MAPI_E_SUCCESS;
+}
 
-		mpm_session_set_private_data(session->session, (void *) emsmdbp_ctx);
-		mpm_session_set_destructor(session->session, emsmdbp_destructor);
+/**
+   \details Process the ROP buffer of an EcDoRpcExt2 call or MAPI/HTTP
+   Execute request
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param rgbIn the request: RPC_HEADER_EXT headers and ROP buffers
+   \param ulFlags the pulFlags of the request
+   \param cbOut the maximum size of the response
+   \param rgbOut pointer to the response to return
 
-		OC_DEBUG(0, "[exchange_emsmdb]: New session added: %d\n", session->session->context_id);
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS EcDoRpcExt2_process(TALLOC_CTX *mem_ctx,
+					   struct emsmdbp_context *emsmdbp_ctx,
+					   DATA_BLOB *rgbIn,
+					   uint32_t ulFlags,
+					   uint32_t cbOut,
+					   DATA_BLOB *rgbOut)
+{
+	enum ndr_err_code		ndr_err;
+	struct mapi2k7_request		mapi2k7_request;
+	struct mapi_response		*mapi_response;
+	struct mapi_response		*next_response;
+	struct mapi_request		chained_request;
+	struct EcDoRpc_MAPI_REQ		*chained_req;
+	struct RPC_HEADER_EXT		RPC_HEADER_EXT;
+	struct ndr_pull			*ndr_pull = NULL;
+	struct ndr_push			*ndr_uncomp_rgbOut;
+	struct ndr_push			*ndr_rgbOut;
+	DATA_BLOB			payload;
+	DATA_BLOB			compressed;
+	bool				compress;
+	bool				chain;
+	int				threshold;
+	uint32_t			bound;
+	uint32_t			used;
+	uint32_t			chained = 0;
+	uint32_t			i;
 
-		DLIST_ADD_END(emsmdb_session, session, struct exchange_emsmdb_session *);
+	/* Extract mapi_request from rgbIn */
+	ndr_pull = ndr_pull_init_blob(rgbIn, mem_ctx);
+	OPENCHANGE_RETVAL_IF(!ndr_pull, MAPI_E_NOT_ENOUGH_RESOURCES, NULL);
+	if (ndr_pull->data_size > cbOut) {
+		talloc_free(ndr_pull);
+		return ecBufferTooSmall;
+	}
+
+	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+	ndr_err = ndr_pull_mapi2k7_request(ndr_pull, NDR_SCALARS|NDR_BUFFERS, &mapi2k7_request);
+	talloc_free(ndr_pull);
+
+	if (ndr_err != NDR_ERR_SUCCESS) {
+		return ecRpcFormat;
 	}
 
+	mapi_response = EcDoRpc_process_transaction(mem_ctx, emsmdbp_ctx, mapi2k7_request.mapi_request);
+
+	/* The client asks for compressed responses by compressing its
+	   requests, unless it disabled compression altogether */
+	compress = (mapi2k7_request.header.Flags & RHEF_Compressed) &&
+		!(ulFlags & pulFlags_NoCompression);
+	chain = (ulFlags & pulFlags_Chain);
+	threshold = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "compress_threshold",
+				   EMSMDB_COMPRESS_THRESHOLD);
+
+	/* Further extended buffers only repeat the last ROP of the
+	   request, against the handles left by the previous pass */
+	chained_request = *mapi2k7_request.mapi_request;
+	chained_req = NULL;
+	if (chain && chained_request.mapi_len > 2) {
+		for (i = 0; chained_request.mapi_req[i].opnum != 0; i++);
+		if (i) {
+			chained_req = talloc_zero_array(mem_ctx, struct EcDoRpc_MAPI_REQ, 2);
+			chained_req[0] = chained_request.mapi_req[i - 1];
+			chained_request.mapi_req = chained_req;
+		}
+	}
+
+	ndr_rgbOut = ndr_push_init_ctx(mem_ctx);
+	ndr_set_flags(&ndr_rgbOut->flags, LIBNDR_FLAG_NOALIGN);
+
+	while (mapi_response) {
+		/* Push MAPI response into a DATA blob */
+		ndr_uncomp_rgbOut = ndr_push_init_ctx(mem_ctx);
+		ndr_set_flags(&ndr_uncomp_rgbOut->flags, LIBNDR_FLAG_NOALIGN);
+		ndr_push_mapi_response(ndr_uncomp_rgbOut, NDR_SCALARS|NDR_BUFFERS, mapi_response);
+
+		payload.data = ndr_uncomp_rgbOut->data;
+		payload.length = ndr_uncomp_rgbOut->offset;
+
+		/* Build RPC_HEADER_EXT header for MAPI response DATA blob */
+		RPC_HEADER_EXT.Version = 0x0000;
+		RPC_HEADER_EXT.Flags = 0;
+		RPC_HEADER_EXT.SizeActual = payload.length;
+
+		/* Compress content if requested, small responses are not worth
+		   it and the compressed one is only used if smaller */
+		if (compress && threshold >= 0 && payload.length >= (size_t)threshold &&
+		    lzxpress_compress_blob(mem_ctx, &payload, &compressed)) {
+			OC_DEBUG(5, "EcDoRpcExt2 response compressed from %zu to %zu bytes",
+				 payload.length, compressed.length);
+			payload = compressed;
+			RPC_HEADER_EXT.Flags |= RHEF_Compressed;
+		}
+		RPC_HEADER_EXT.Flags |= (mapi2k7_request.header.Flags & RHEF_XorMagic);
+		RPC_HEADER_EXT.Size = payload.length;
+
+		/* Process the last ROP again if another extended buffer
+		   of its maximum size still fits in pcbOut, and the call
+		   did not spend its time slice */
+		next_response = NULL;
+		used = ndr_rgbOut->offset + 8 + payload.length;
+		if (chained_req && EcDoRpc_chainable_request(&chained_request, mapi_response, &bound) &&
+		    used < cbOut && cbOut - used >= 8 + bound && !emsmdbp_sched_yield(emsmdbp_ctx)) {
+			chained_request.handles = mapi_response->handles;
+			next_response = EcDoRpc_process_request(mem_ctx, emsmdbp_ctx, &chained_request, false);
+			chained++;
+		}
+		if (!next_response) {
+			RPC_HEADER_EXT.Flags |= RHEF_Last;
+		}
+
+		/* Obfuscate content if applicable*/
+		if (RPC_HEADER_EXT.Flags & RHEF_XorMagic) {
+			obfuscate_data(payload.data, payload.length, 0xA5);
+		}
+
+		/* Push the constructed blob */
+		ndr_push_RPC_HEADER_EXT(ndr_rgbOut, NDR_SCALARS|NDR_BUFFERS, &RPC_HEADER_EXT);
+		ndr_push_bytes(ndr_rgbOut, payload.data, payload.length);
+
+		talloc_free(ndr_uncomp_rgbOut);
+		if (RPC_HEADER_EXT.Flags & RHEF_Compressed) {
+			talloc_free(compressed.data);
+		}
+		talloc_free(mapi_response);
+		mapi_response = next_response;
+	}
+	talloc_free(chained_req);
+	talloc_free(mapi2k7_request.mapi_request);
+
+	if (chained) {
+		OC_DEBUG(5, "EcDoRpcExt2 response packed %"PRIu32" chained extended buffers", chained);
+	}
+
+	/* Push MAPI response into a DATA blob */
+	rgbOut->data = ndr_rgbOut->data;
+	rgbOut->length = ndr_rgbOut->offset;
+
 	return MAPI_E_SUCCESS;
 }
 
@@ -1378,19 +2269,13 @@ static enum MAPISTATUS dcesrv_EcDoRpcExt2(struct dcesrv_call_state *dce_call,
 					  TALLOC_CTX *mem_ctx,
 					  struct EcDoRpcExt2 *r)
 {
-	enum ndr_err_code		ndr_err;
+	enum MAPISTATUS			retval;
 	struct exchange_emsmdb_session	*session;
 	struct emsmdbp_context		*emsmdbp_ctx = NULL;
-	struct mapi2k7_request		mapi2k7_request;
-	struct mapi_response		*mapi_response;
-	struct RPC_HEADER_EXT		RPC_HEADER_EXT;
-	struct ndr_pull			*ndr_pull = NULL;
-	struct ndr_push			*ndr_uncomp_rgbOut;
-	struct ndr_push			*ndr_comp_rgbOut;
-	struct ndr_push			*ndr_rgbOut;
 	uint32_t			pulFlags = 0x0;
 	uint32_t			pulTransTime = 0;
 	DATA_BLOB			rgbIn;
+	DATA_BLOB			rgbOut;
 
 	OC_DEBUG(3, "exchange_emsmdb: EcDoRpcExt2 (0xB)\n");
 
@@ -1424,63 +2309,21 @@ static enum MAPISTATUS dcesrv_EcDoRpcExt2(struct dcesrv_call_state *dce_call,
 		return ecRpcFailed;
 	}
 
-	/* Extract mapi_request from rgbIn */
+	/* Process the ROP buffer */
 	rgbIn.data = r->in.rgbIn;
 	rgbIn.length = r->in.cbIn;
 
-	ndr_pull = ndr_pull_init_blob(&rgbIn, mem_ctx);
-	if (ndr_pull->data_size > *r->in.pcbOut) {
-		r->out.result = ecBufferTooSmall;
-		talloc_free(ndr_pull);
-		return ecBufferTooSmall;
-	}
-
-	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
-	ndr_err = ndr_pull_mapi2k7_request(ndr_pull, NDR_SCALARS|NDR_BUFFERS, &mapi2k7_request);
-	talloc_free(ndr_pull);
-
-	if (ndr_err != NDR_ERR_SUCCESS) {
-		r->out.result = ecRpcFormat;
-		return ecRpcFormat;
+	retval = EcDoRpcExt2_process(mem_ctx, emsmdbp_ctx, &rgbIn, *r->in.pulFlags, *r->in.pcbOut, &rgbOut);
+	if (retval != MAPI_E_SUCCESS) {
+		r->out.result = retval;
+		return retval;
 	}
 
-	mapi_response = EcDoRpc_process_transaction(mem_ctx, emsmdbp_ctx, mapi2k7_request.mapi_request);
-	talloc_free(mapi2k7_request.mapi_request);
-
 	/* Fill EcDoRpcExt2 reply */
 	r->out.handle = r->in.handle;
 	*r->out.pulFlags = pulFlags;
-
-	/* Push MAPI response into a DATA blob */
-	ndr_uncomp_rgbOut = ndr_push_init_ctx(mem_ctx);
-	ndr_set_flags(&ndr_uncomp_rgbOut->flags, LIBNDR_FLAG_NOALIGN);
-	ndr_push_mapi_response(ndr_uncomp_rgbOut, NDR_SCALARS|NDR_BUFFERS, mapi_response);
-	talloc_free(mapi_response);
-
-	/* TODO: compress if requested */
-	ndr_comp_rgbOut = ndr_uncomp_rgbOut;
-
-	/* Build RPC_HEADER_EXT header for MAPI response DATA blob */
-	RPC_HEADER_EXT.Version = 0x0000;
-	RPC_HEADER_EXT.Flags = RHEF_Last;
-	RPC_HEADER_EXT.Flags |= (mapi2k7_request.header.Flags & RHEF_XorMagic);
-	RPC_HEADER_EXT.Size = ndr_comp_rgbOut->offset;
-	RPC_HEADER_EXT.SizeActual = ndr_comp_rgbOut->offset;
-
-	/* Obfuscate content if applicable*/
-	if (RPC_HEADER_EXT.Flags & RHEF_XorMagic) {
-		obfuscate_data(ndr_comp_rgbOut->data, ndr_comp_rgbOut->offset, 0xA5);
-	}
-
-	/* Push the constructed blob */
-	ndr_rgbOut = ndr_push_init_ctx(mem_ctx);
-	ndr_set_flags(&ndr_rgbOut->flags, LIBNDR_FLAG_NOALIGN);
-	ndr_push_RPC_HEADER_EXT(ndr_rgbOut, NDR_SCALARS|NDR_BUFFERS, &RPC_HEADER_EXT);
-	ndr_push_bytes(ndr_rgbOut, ndr_comp_rgbOut->data, ndr_comp_rgbOut->offset);
-
-	/* Push MAPI response into a DATA blob */
-	r->out.rgbOut = ndr_rgbOut->data;
-	*r->out.pcbOut = ndr_rgbOut->offset;
+	r->out.rgbOut = rgbOut.data;
+	*r->out.pcbOut = rgbOut.length;
 
 	*r->out.pulTransTime = pulTransTime;
 
@@ -1605,6 +2448,13 @@ static enum MAPISTATUS dcesrv_EcDoAsyncConnectEx(struct dcesrv_call_state *dce_c
 		return MAPI_E_LOGON_FAILED;
 	}
 
+	/* Step 4. Receive the notifications of the session in this process */
+	retval = mapistore_notification_bus_subscribe(emsmdbp_ctx->mstore_ctx, r->in.handle->uuid);
+	if (retval != MAPISTORE_SUCCESS) {
+		OC_DEBUG(0, "[EcDoAsyncConnectEx]: notification bus subscription failed with '%s'\n",
+			 mapistore_errstr(retval));
+	}
+
 	*r->out.async_handle = handle->wire_handle;
 	r->out.result = MAPI_E_SUCCESS;
 
@@ -1612,6 +2462,233 @@ static enum MAPISTATUS dcesrv_EcDoAsyncConnectEx(struct dcesrv_call_state *dce_c
 }
 
 
+/**
+   \details Prepare the process serving MAPI/HTTP requests
+
+   \param lp_ctx pointer to the loadparm context
+
+   \return true on success, otherwise false
+ */
+_PUBLIC_ bool emsmdb_mapihttp_init(struct loadparm_context *lp_ctx)
+{
+	if (!emsmdb_session) {
+		emsmdb_session = talloc_zero(NULL, struct exchange_emsmdb_session);
+		if (!emsmdb_session) return false;
+	}
+
+	if (!openchange_db_ctx) {
+		openchange_db_ctx = emsmdbp_openchangedb_init(lp_ctx);
+	}
+
+	return (openchange_db_ctx != NULL);
+}
+
+/**
+   \details Retrieve the emsmdbp context of a MAPI/HTTP session
+
+   \param cookie the session context cookie
+   \param username the account name of the authenticated user
+
+   \return pointer to the emsmdbp context on success, otherwise NULL
+ */
+static struct emsmdbp_context *emsmdb_mapihttp_context(const struct GUID *cookie, const char *username)
+{
+	struct exchange_emsmdb_session	*session;
+	struct emsmdbp_context		*emsmdbp_ctx;
+
+	/* Sanity checks */
+	if (!cookie || !username) return NULL;
+
+	session = dcesrv_find_emsmdb_session((struct GUID *)cookie);
+	if (!session || !session->session) return NULL;
+
+	/* The cookie is only valid for the user who logged on */
+	emsmdbp_ctx = (struct emsmdbp_context *) session->session->private_data;
+	if (!emsmdbp_ctx || !emsmdbp_ctx->username || strcasecmp(emsmdbp_ctx->username, username)) {
+		OC_DEBUG(1, "[exchange_emsmdb]: MAPI/HTTP session used by another user (%s)", username);
+		return NULL;
+	}
+
+	return emsmdbp_ctx;
+}
+
+/**
+   \details Log a user on over MAPI/HTTP (Connect request type)
+
+   \param mem_ctx pointer to the memory context
+   \param lp_ctx pointer to the loadparm context
+   \param ev_ctx pointer to the event context of the process
+   \param username the account name of the authenticated user
+   \param szUserDN the legacyExchangeDN of the mailbox to log on
+   \param ulLcidString the locale of the client
+   \param server_id the server identifier of the process
+   \param context_id the identifier of the new session
+   \param cookie pointer to the session context cookie to return
+   \param szDNPrefix pointer to the DN prefix of the server to return
+   \param szDisplayName pointer to the display name of the user to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdb_mapihttp_connect(TALLOC_CTX *mem_ctx,
+						 struct loadparm_context *lp_ctx,
+						 struct tevent_context *ev_ctx,
+						 const char *username,
+						 const char *szUserDN,
+						 uint32_t ulLcidString,
+						 struct server_id server_id,
+						 uint32_t context_id,
+						 struct GUID *cookie,
+						 const char **szDNPrefix,
+						 const char **szDisplayName)
+{
+	enum MAPISTATUS		retval;
+	enum mapistore_error	ret;
+	struct emsmdbp_context	*emsmdbp_ctx;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!username, MAPI_E_LOGON_FAILED, NULL);
+	OPENCHANGE_RETVAL_IF(!szUserDN || !strlen(szUserDN), MAPI_E_NO_ACCESS, NULL);
+	OPENCHANGE_RETVAL_IF(!cookie, MAPI_E_INVALID_PARAMETER, NULL);
+
+	retval = EcDoConnectEx_logon(mem_ctx, lp_ctx, username, szUserDN, ulLcidString,
+				     &emsmdbp_ctx, szDNPrefix, szDisplayName);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	emsmdbp_ctx->ev_ctx = ev_ctx;
+
+	*cookie = GUID_random();
+	if (emsmdbp_set_session_uuid(emsmdbp_ctx, *cookie) == false) {
+		talloc_free(emsmdbp_ctx);
+		return MAPI_E_LOGON_FAILED;
+	}
+
+	retval = EcDoConnectEx_register(emsmdbp_ctx, *cookie, server_id, context_id, time(NULL));
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	/* There is no asynchronous pipe: NotificationWait requests wait
+	 * on the session itself */
+	ret = mapistore_notification_session_add(emsmdbp_ctx->mstore_ctx, *cookie, *cookie, username);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(1, "[exchange_emsmdb]: MAPI/HTTP session registration failed with '%s'",
+			 mapistore_errstr(ret));
+	}
+	ret = mapistore_notification_bus_subscribe(emsmdbp_ctx->mstore_ctx, *cookie);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(1, "[exchange_emsmdb]: MAPI/HTTP notification bus subscription failed with '%s'",
+			 mapistore_errstr(ret));
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Process the ROP buffer of a MAPI/HTTP Execute request
+
+   \param mem_ctx pointer to the memory context
+   \param cookie the session context cookie
+   \param username the account name of the authenticated user
+   \param rgbIn the ROP buffer of the request
+   \param ulFlags the flags of the request
+   \param cbOut the maximum size of the response
+   \param rgbOut pointer to the ROP buffer of the response
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdb_mapihttp_execute(TALLOC_CTX *mem_ctx,
+						 const struct GUID *cookie,
+						 const char *username,
+						 DATA_BLOB *rgbIn,
+						 uint32_t ulFlags,
+						 uint32_t cbOut,
+						 DATA_BLOB *rgbOut)
+{
+	struct emsmdbp_context	*emsmdbp_ctx;
+
+	emsmdbp_ctx = emsmdb_mapihttp_context(cookie, username);
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_LOGON_FAILED, NULL);
+	OPENCHANGE_RETVAL_IF(!rgbIn || !rgbOut, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(cbOut < 0x00000008, ecRpcFailed, NULL);
+
+	return EcDoRpcExt2_process(mem_ctx, emsmdbp_ctx, rgbIn, ulFlags, cbOut, rgbOut);
+}
+
+/**
+   \details Check whether notifications are waiting for a MAPI/HTTP
+   session (NotificationWait request type)
+
+   Delivered notifications are kept on the session until the next
+   Execute request returns them.
+
+   \param cookie the session context cookie
+   \param username the account name of the authenticated user
+   \param pending pointer to the boolean to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdb_mapihttp_notification_pending(const struct GUID *cookie,
+							      const char *username,
+							      bool *pending)
+{
+	struct emsmdbp_context	*emsmdbp_ctx;
+	enum mapistore_error	ret;
+	DATA_BLOB		fetched;
+	uint8_t			*data;
+
+	emsmdbp_ctx = emsmdb_mapihttp_context(cookie, username);
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_LOGON_FAILED, NULL);
+	OPENCHANGE_RETVAL_IF(!pending, MAPI_E_INVALID_PARAMETER, NULL);
+
+	ret = mapistore_notification_bus_fetch(emsmdbp_ctx, emsmdbp_ctx->mstore_ctx, emsmdbp_ctx->session_uuid,
+					       &fetched.data, &fetched.length);
+	if (ret == MAPISTORE_SUCCESS && fetched.length) {
+		if (!emsmdbp_ctx->notifications.length) {
+			emsmdbp_ctx->notifications = fetched;
+		} else {
+			data = talloc_realloc(emsmdbp_ctx, emsmdbp_ctx->notifications.data, uint8_t,
+					      emsmdbp_ctx->notifications.length + fetched.length);
+			OPENCHANGE_RETVAL_IF(!data, MAPI_E_NOT_ENOUGH_RESOURCES, fetched.data);
+			memcpy(data + emsmdbp_ctx->notifications.length, fetched.data, fetched.length);
+			emsmdbp_ctx->notifications.data = data;
+			emsmdbp_ctx->notifications.length += fetched.length;
+			talloc_free(fetched.data);
+		}
+	}
+
+	*pending = (emsmdbp_ctx->notifications.length != 0);
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Log a MAPI/HTTP session off (Disconnect request type)
+
+   \param cookie the session context cookie
+   \param username the account name of the authenticated user, NULL
+   when the session expired
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdb_mapihttp_disconnect(const struct GUID *cookie, const char *username)
+{
+	struct exchange_emsmdb_session	*session;
+
+	OPENCHANGE_RETVAL_IF(!cookie, MAPI_E_INVALID_PARAMETER, NULL);
+	if (username) {
+		OPENCHANGE_RETVAL_IF(!emsmdb_mapihttp_context(cookie, username), MAPI_E_LOGON_FAILED, NULL);
+	}
+
+	session = dcesrv_find_emsmdb_session((struct GUID *)cookie);
+	OPENCHANGE_RETVAL_IF(!session, MAPI_E_NOT_FOUND, NULL);
+
+	if (dcesrv_release_emsmdb_session(session) == true) {
+		OC_DEBUG(5, "MAPI/HTTP session released (%"PRIu32" live)", emsmdb_session_count);
+	} else {
+		OC_DEBUG(5, "MAPI/HTTP session found and ref_count decreased");
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Dispatch incoming EMSMDB call to the correct OpenChange
    server function
@@ -1624,21 +2701,10 @@ static enum MAPISTATUS dcesrv_EcDoAsyncConnectEx(struct dcesrv_call_state *dce_c
 
    \return NT_STATUS_OK;
  */
-static NTSTATUS dcesrv_exchange_emsmdb_dispatch(struct dcesrv_call_state *dce_call,
-						TALLOC_CTX *mem_ctx,
-						void *r, struct mapiproxy *mapiproxy)
+static void dcesrv_exchange_emsmdb_call(struct dcesrv_call_state *dce_call,
+					TALLOC_CTX *mem_ctx, void *r)
 {
-	const struct ndr_interface_table	*table;
-	uint16_t				opnum;
-
-	table = (const struct ndr_interface_table *) dce_call->context->iface->private_data;
-	opnum = dce_call->pkt.u.request.opnum;
-
-	/* Sanity checks */
-	if (!table) return NT_STATUS_UNSUCCESSFUL;
-	if (table->name && strcmp(table->name, NDR_EXCHANGE_EMSMDB_NAME)) return NT_STATUS_UNSUCCESSFUL;
-
-	switch (opnum) {
+	switch (dce_call->pkt.u.request.opnum) {
 	case NDR_ECDOCONNECT:
 		dcesrv_EcDoConnect(dce_call, mem_ctx, (struct EcDoConnect *)r);
 		break;
@@ -1685,6 +2751,78 @@ static NTSTATUS dcesrv_exchange_emsmdb_dispatch(struct dcesrv_call_state *dce_ca
 		dcesrv_EcDoAsyncConnectEx(dce_call, mem_ctx, (struct EcDoAsyncConnectEx *)r);
 		break;
 	}
+}
+
+
+struct emsmdb_async_call {
+	struct dcesrv_call_state	*dce_call;
+	TALLOC_CTX			*mem_ctx;
+	void				*r;
+};
+
+static void dcesrv_exchange_emsmdb_async_work(void *private_data)
+{
+	struct emsmdb_async_call	*call = (struct emsmdb_async_call *) private_data;
+
+	dcesrv_exchange_emsmdb_call(call->dce_call, call->mem_ctx, call->r);
+}
+
+static void dcesrv_exchange_emsmdb_async_done(void *private_data)
+{
+	struct emsmdb_async_call	*call = (struct emsmdb_async_call *) private_data;
+	NTSTATUS			status;
+
+	status = dcesrv_reply(call->dce_call);
+	if (!NT_STATUS_IS_OK(status)) {
+		OC_DEBUG(0, "exchange_emsmdb: dcesrv_reply() failed - %s", nt_errstr(status));
+	}
+}
+
+
+/**
+   \details Dispatch EMSMDB calls, run by the worker threads when
+   enabled and replied to asynchronously
+
+   \param dce_call pointer to the session context
+   \param mem_ctx pointer to the memory context
+   \param r generic pointer on EMSMDB data
+   \param mapiproxy pointer to the mapiproxy structure controlling
+   mapiproxy behavior
+
+   \return NT_STATUS_OK on success, otherwise NTSTATUS error
+ */
+static NTSTATUS dcesrv_exchange_emsmdb_dispatch(struct dcesrv_call_state *dce_call,
+						TALLOC_CTX *mem_ctx,
+						void *r, struct mapiproxy *mapiproxy)
+{
+	const struct ndr_interface_table	*table;
+	struct emsmdb_async_call		*call;
+
+	table = (const struct ndr_interface_table *) dce_call->context->iface->private_data;
+
+	/* Sanity checks */
+	if (!table) return NT_STATUS_UNSUCCESSFUL;
+	if (table->name && strcmp(table->name, NDR_EXCHANGE_EMSMDB_NAME)) return NT_STATUS_UNSUCCESSFUL;
+
+	if (emsmdbp_threads_init(dce_call->conn->dce_ctx->lp_ctx, dce_call->event_ctx)) {
+		call = talloc_zero(mem_ctx, struct emsmdb_async_call);
+		NT_STATUS_HAVE_NO_MEMORY(call);
+		call->dce_call = dce_call;
+		call->mem_ctx = mem_ctx;
+		call->r = r;
+
+		dce_call->state_flags |= DCESRV_CALL_STATE_FLAG_ASYNC;
+		if (emsmdbp_threads_run(dce_call->conn->server_id, dce_call->context->context_id,
+					dcesrv_exchange_emsmdb_async_work, dcesrv_exchange_emsmdb_async_done, call)) {
+			return NT_STATUS_OK;
+		}
+		dce_call->state_flags &= ~DCESRV_CALL_STATE_FLAG_ASYNC;
+		talloc_free(call);
+	}
+
+	emsmdbp_threads_lock();
+	dcesrv_exchange_emsmdb_call(dce_call, mem_ctx, r);
+	emsmdbp_threads_unlock();
 
 	return NT_STATUS_OK;
 }
@@ -1699,11 +2837,21 @@ static NTSTATUS dcesrv_exchange_emsmdb_dispatch(struct dcesrv_call_state *dce_ca
  */
 static NTSTATUS dcesrv_exchange_emsmdb_init(struct dcesrv_context *dce_ctx)
 {
+	enum mapistore_error	retval;
+
 	/* Initialize exchange_emsmdb session */
 	emsmdb_session = talloc_zero(dce_ctx, struct exchange_emsmdb_session);
 	if (!emsmdb_session) return NT_STATUS_NO_MEMORY;
 	emsmdb_session->session = NULL;
 
+	/* Serve MAPI/HTTP from a process of its own, forked before
+	 * openchangedb is opened */
+	if (lpcfg_parm_bool(dce_ctx->lp_ctx, NULL, "emsmdb", "mapihttp", false)) {
+		if (emsmdbp_mapihttp_start(dce_ctx->lp_ctx) == false) {
+			OC_DEBUG(0, "[exchange_emsmdb] Unable to start the MAPI/HTTP endpoint");
+		}
+	}
+
 	/* Open read/write context on OpenChange dispatcher database */
 	openchange_db_ctx = emsmdbp_openchangedb_init(dce_ctx->lp_ctx);
 	if (!openchange_db_ctx) {
@@ -1711,10 +2859,38 @@ static NTSTATUS dcesrv_exchange_emsmdb_init(struct dcesrv_context *dce_ctx)
 		return NT_STATUS_INTERNAL_ERROR;
 	}
 
+	/* Load the backends and fill the shared caches before the first
+	 * client connects */
+	if (lpcfg_parm_bool(dce_ctx->lp_ctx, NULL, "emsmdb", "warmup", false)) {
+		retval = mapistore_warmup(dce_ctx->lp_ctx, NULL);
+		if (retval != MAPISTORE_SUCCESS) {
+			OC_DEBUG(1, "[exchange_emsmdb] mapistore warmup failed: %s", mapistore_errstr(retval));
+		}
+	}
+
 	return NT_STATUS_OK;
 }
 
 
+struct emsmdb_async_unbind {
+	struct server_id	server_id;
+	uint32_t		context_id;
+};
+
+static NTSTATUS dcesrv_exchange_emsmdb_release(struct server_id server_id, uint32_t context_id);
+
+static void dcesrv_exchange_emsmdb_unbind_work(void *private_data)
+{
+	struct emsmdb_async_unbind	*unbind = (struct emsmdb_async_unbind *) private_data;
+
+	dcesrv_exchange_emsmdb_release(unbind->server_id, unbind->context_id);
+}
+
+static void dcesrv_exchange_emsmdb_unbind_done(void *private_data)
+{
+	talloc_free(private_data);
+}
+
 /**
    \details Terminate the EMSMDB connection and release the associated
    session and context if still available. This case occurs when the
@@ -1725,27 +2901,47 @@ static NTSTATUS dcesrv_exchange_emsmdb_init(struct dcesrv_context *dce_ctx)
 
    \return NT_STATUS_OK on success
  */
-
-/* FIXME: code temporarily disabled as we don't master the logic behind session handles yet... */
 static NTSTATUS dcesrv_exchange_emsmdb_unbind(struct server_id server_id, uint32_t context_id)
 {
-	/* struct exchange_emsmdb_session	*session; */
-	/* bool ret; */
-
-	OC_DEBUG(0, "dcesrv_exchange_emsmdb_unbind: server_id=%d, context_id=0x%x", server_id, context_id);
-
-	/* session = dcesrv_find_emsmdb_session_by_server_id(&server_id, context_id); */
-	/* if (session) { */
-	/* 	ret = mpm_session_release(session->session); */
-	/* 	if (ret == true) { */
-	/* 		DLIST_REMOVE(emsmdb_session, session); */
-	/* 		OC_DEBUG(5, ("[%s:%d]: Session found and released\n",  */
-	/* 			  __FUNCTION__, __LINE__)); */
-	/* 	} else { */
-	/* 		OC_DEBUG(5, ("[%s:%d]: Session found and ref_count decreased\n", */
-	/* 			  __FUNCTION__, __LINE__)); */
-	/* 	} */
-	/* } */
+	struct emsmdb_async_unbind	*unbind;
+	NTSTATUS			status;
+
+	OC_DEBUG(5, "dcesrv_exchange_emsmdb_unbind: context_id=0x%x", context_id);
+
+	/* Release the sessions once the calls queued on the connection ran */
+	if (emsmdbp_threads_enabled()) {
+		unbind = talloc_zero(NULL, struct emsmdb_async_unbind);
+		NT_STATUS_HAVE_NO_MEMORY(unbind);
+		unbind->server_id = server_id;
+		unbind->context_id = context_id;
+		if (emsmdbp_threads_run(server_id, context_id, dcesrv_exchange_emsmdb_unbind_work,
+					dcesrv_exchange_emsmdb_unbind_done, unbind)) {
+			return NT_STATUS_OK;
+		}
+		talloc_free(unbind);
+	}
+
+	emsmdbp_threads_lock();
+	status = dcesrv_exchange_emsmdb_release(server_id, context_id);
+	emsmdbp_threads_unlock();
+
+	return status;
+}
+
+static NTSTATUS dcesrv_exchange_emsmdb_release(struct server_id server_id, uint32_t context_id)
+{
+	struct exchange_emsmdb_session	*session;
+	bool				ret;
+
+	/* The connection is gone: drop every reference held through it */
+	while ((session = dcesrv_find_emsmdb_session_by_server_id(&server_id, context_id)) != NULL) {
+		ret = dcesrv_release_emsmdb_session(session);
+		if (ret == true) {
+			OC_DEBUG(5, "Session found and released (%"PRIu32" live)", emsmdb_session_count);
+		} else {
+			OC_DEBUG(5, "Session found and ref_count decreased");
+		}
+	}
 
 	return NT_STATUS_OK;
 }
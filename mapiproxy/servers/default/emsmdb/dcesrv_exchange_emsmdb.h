@@ -44,6 +44,21 @@
 #endif
 #endif
 
+/* Memory state of a session, see emsmdbp_memory.c */
+enum emsmdbp_memory_state {
+	EMSMDBP_MEMORY_NORMAL = 0,
+	EMSMDBP_MEMORY_SOFT,		/* past the soft limit: buffers shrink */
+	EMSMDBP_MEMORY_HARD		/* past the hard limit: ROPs are refused */
+};
+
+struct emsmdbp_memory {
+	size_t					size;		/* talloc size of the session at the last sample */
+	size_t					peak;
+	time_t					sampled;
+	enum emsmdbp_memory_state		state;
+	struct emsmdbp_session_stats		*stats;		/* gauge in the statistics file, if any */
+};
+
 struct emsmdbp_context {
 	char					*szUserDN;
 	char					*szDisplayName;
@@ -58,21 +73,113 @@ struct emsmdbp_context {
 
 	TALLOC_CTX				*mem_ctx;
 	struct GUID				session_uuid;
+	uint32_t				table_generation; /* bumped whenever table contents may have changed */
+	struct tevent_context			*ev_ctx;
+	struct emsmdbp_deferred_delete		*deferred_deletes;
+	struct tevent_timer			*deferred_timer;
+	struct emsmdbp_submit			*submits; /* messages waiting to be handed to their backend */
+	struct tevent_timer			*submit_timer;
+	struct emsmdbp_propset			*propsets; /* prepared property sets, most recently used first */
+	struct emsmdbp_memory			memory;
+	struct emsmdbp_search_folder		*search_folders; /* search folders materialized in this session */
+	struct emsmdbp_syncstate		*syncstates; /* uploaded ICS states, most recently used first */
+	DATA_BLOB				notifications; /* fetched by a MAPI/HTTP NotificationWait, not returned yet */
+	struct emsmdbp_folder_cache		*folder_cache; /* resolved folder parents, most recently used first */
+	uint32_t				folder_cache_count;
+	struct emsmdbp_replica_cache		*replica_cache; /* resolved replicas, most recently used first */
+	uint32_t				replica_cache_count;
+	time_t					idle_since; /* beginning of the last call */
+	struct tevent_timer			*idle_timer;
+	struct emsmdbp_object			**hibernated; /* objects to reopen, see emsmdbp_idle.c */
+	uint32_t				hibernated_count;
+	struct timespec				slice_deadline; /* end of the time slice of bulk producers, see emsmdbp_sched.c */
+	bool					shared_cn_active; /* a ROP is being processed */
+	char					*shared_cn_owner; /* owner shared_cn was allocated for, NULL if none */
+	uint64_t				shared_cn; /* change number shared by the changes of the ROP */
+};
+
+/* A tag array resolved once, see emsmdbp_propset.c */
+struct emsmdbp_propset {
+	struct emsmdbp_propset		*prev;
+	struct emsmdbp_propset		*next;
+	uint32_t			hash;
+	uint16_t			count;
+	enum MAPITAGS			*tags;		/* as sent by the client */
+	struct SPropTagArray		properties;	/* with the untyped tags typed */
+	bool				*untyped_status;
+	bool				may_stream;	/* a string or binary property is requested */
+};
+
+/* An ICS state parsed and validated once, see emsmdbp_syncstate.c */
+struct emsmdbp_syncstate {
+	struct emsmdbp_syncstate	*prev;
+	struct emsmdbp_syncstate	*next;
+	uint32_t			hash;
+	uint32_t			state_property;
+	DATA_BLOB			buffer;		/* as uploaded by the client */
+	struct idset			*idset;
+};
+
+/* A folder resolved once, see emsmdbp_folder_cache.c */
+struct emsmdbp_folder_cache {
+	struct emsmdbp_folder_cache	*prev;
+	struct emsmdbp_folder_cache	*next;
+	const char			*owner;		/* of the mailbox */
+	uint64_t			fid;
+	uint64_t			parent_fid;
+	bool				parent_known;
+	struct emsmdbp_object		*object;	/* open folder object, not owned */
+};
+
+/* A replica resolved once, see emsmdbp_replica_cache.c */
+struct emsmdbp_replica_cache {
+	struct emsmdbp_replica_cache	*prev;
+	struct emsmdbp_replica_cache	*next;
+	const char			*owner;		/* of the mailbox */
+	uint16_t			replid;
+	struct GUID			guid;
 };
 
 struct exchange_emsmdb_session {
 	uint32_t			pullTimeStamp;
 	struct mpm_session		*session;
         struct GUID                     uuid;
-	struct exchange_emsmdb_session	*prev;
-	struct exchange_emsmdb_session	*next;
+};
+
+/* Temporary file backing a stream grown past its spill size */
+struct emsmdbp_stream_spill {
+	int			fd;
+	uint8_t			*map;
+	size_t			size;
 };
 
 struct emsmdbp_stream {
 	size_t			position;
 	DATA_BLOB		buffer;
+	size_t			capacity; /* bytes allocated by emsmdbp_stream_write_buffer, 0 if buffer is foreign */
+	size_t			spill_size; /* capacity from which the buffer moves to a temporary file, 0 never */
+	const char		*spill_dir;
+	struct emsmdbp_stream_spill *spill;
+};
+
+/* A place where a FastTransfer buffer may end */
+struct emsmdbp_stream_segment {
+	uint32_t		offset;
+	uint32_t		min_size; /* the value ending at offset may be split after that many bytes, 0 never */
 };
 
+/* Boundaries of a FastTransfer stream, by increasing offset */
+struct emsmdbp_stream_segments {
+	struct emsmdbp_stream_segment	*entries;
+	uint32_t			count;
+	uint32_t			alloc;
+	uint32_t			next; /* first boundary past the last buffer sent */
+};
+
+#define	EMSMDBP_STREAM_MIN_CAPACITY	4096
+/* Room kept past the data for the NUL terminator of string properties */
+#define	EMSMDBP_STREAM_SLACK		2
+
 struct emsmdbp_syncconfigure_request {
 	bool is_collector;
 	bool contents_mode;
@@ -132,12 +239,72 @@ struct emsmdbp_object_folder {
 	uint32_t			contextID; /* requires mapistore_root == true, undefined otherwise */
 	bool				mapistore_root; /* root mapistore container or not */
 	struct SRow			*postponed_props; /* storage for properties set until PR_CONTAINER_CLASS_UNICODE is set */
+	struct emsmdbp_folder_cache	*cache_entry; /* when reusable as a parent, see emsmdbp_folder_cache.c */
+};
+
+/* Properties read along with a message by OpenMessage, see emsmdbp_object_message_prefetch */
+struct emsmdbp_message_prefetch {
+	uint32_t				generation; /* table_generation they were read at */
+	struct SPropTagArray			properties;
+	void					**data_pointers;
+	enum MAPISTATUS				*retvals;
 };
 
 struct emsmdbp_object_message {
 	uint64_t				messageID;
 	bool					read_write;
 	struct mapistore_freebusy_properties	*fb_properties;
+	struct openchangedb_message_counts	*counts; /* contribution to the folder counters, NULL if unknown */
+	struct emsmdbp_message_prefetch		*prefetch;
+	struct SRow				*pending_props; /* set until SaveChangesMessage, see emsmdbp_object_message_flush_properties */
+};
+
+/* Number of serialized rows kept per table, direct-mapped on the row position */
+#define	EMSMDBP_TABLE_ROW_CACHE_SIZE	256
+
+struct emsmdbp_table_row_cache_entry {
+	bool					valid;
+	uint32_t				row_id;
+	DATA_BLOB				row;
+};
+
+struct emsmdbp_table_row_cache {
+	uint32_t				generation;
+	uint32_t				row_count; /* backend row count the rows were read at */
+	struct emsmdbp_table_row_cache_entry	entries[EMSMDBP_TABLE_ROW_CACHE_SIZE];
+};
+
+struct emsmdbp_table_bookmark {
+	uint32_t				id;
+	uint32_t				row_id;
+	struct Binary_r				instance_key; /* PidTagInstanceKey of the row, empty if not in the column set */
+	struct emsmdbp_table_bookmark		*prev;
+	struct emsmdbp_table_bookmark		*next;
+};
+
+#define	EMSMDBP_TABLE_CATEGORY_NONE	0xFFFFFFFF
+
+struct emsmdbp_table_category {
+	uint64_t				id; /* CategoryId, also the header PidTagInstID */
+	uint16_t				depth;
+	uint32_t				parent; /* index of the parent header */
+	void					*value; /* NULL if the rows lack the column */
+	uint32_t				start; /* first backend row of the category */
+	uint32_t				count; /* number of backend rows */
+	uint32_t				position; /* visible position of the header */
+	bool					expanded;
+};
+
+struct emsmdbp_table_categories {
+	uint32_t				generation;
+	uint16_t				level_count;
+	uint16_t				expanded_count;
+	enum MAPITAGS				*proptags;
+	uint32_t				row_count; /* number of backend rows */
+	uint32_t				count;
+	struct emsmdbp_table_category		*headers; /* in table order */
+	uint32_t				visible_count;
+	uint32_t				*visible; /* indexes of the visible headers */
 };
 
 struct emsmdbp_object_table {
@@ -150,6 +317,20 @@ struct emsmdbp_object_table {
 	uint32_t				denominator;
 	uint8_t					flags;
 	bool					subscription;
+	struct emsmdbp_table_row_cache		*row_cache; /* QueryRows rows for the current column set */
+	enum MAPITAGS				sort_proptag; /* leading sort column, 0 if unsorted */
+	enum TABLE_SORT				sort_order;
+	struct emsmdbp_table_bookmark		*bookmarks;
+	uint32_t				bookmark_id;
+	struct emsmdbp_table_categories		*categories; /* NULL unless the sort order is categorized */
+	struct mapiproxy_rules			*rules; /* rows of a MAPISTORE_RULE_TABLE */
+	struct emsmdbp_search_folder		*search; /* members of a search folder contents table */
+	bool					attach_data_deferred; /* attachment bytes are left to OpenStream */
+};
+
+struct emsmdbp_table_row_props {
+	void					**data_pointers;
+	enum MAPISTATUS				*retvals;
 };
 
 struct emsmdbp_object_stream {
@@ -157,6 +338,8 @@ struct emsmdbp_object_stream {
 	bool				needs_commit;
 	enum MAPITAGS			property;
 	struct emsmdbp_stream		stream;
+	void				*backend_stream; /* mapistore property stream, stream.buffer is unused when set */
+	uint64_t			backend_size;
 };
 
 struct emsmdbp_stream_data {
@@ -204,8 +387,7 @@ struct emsmdbp_object_synccontext {
 
 	/* download buffers */
 	struct emsmdbp_stream	stream;
-	uint32_t		*cutmarks;
-	uint32_t		next_cutmark_idx;
+	struct emsmdbp_stream_segments	*segments;
 
 	/* SyncOpenCollector specific attributes */
 	/* Involved fmids in upload operations */
@@ -218,8 +400,7 @@ struct emsmdbp_object_ftcontext {
 	uint16_t		total_steps;
 
 	struct emsmdbp_stream	stream;
-	uint32_t		*cutmarks;
-	uint32_t		next_cutmark_idx;
+	struct emsmdbp_stream_segments	*segments;
 };
 
 union emsmdbp_objects {
@@ -241,12 +422,90 @@ struct emsmdbp_object {
 	struct emsmdbp_context		*emsmdbp_ctx;
         void                            *backend_object;  /* used with mapistore */
 	struct emsmdbp_stream_data      *stream_data;
+	bool				hibernated; /* backend_object released until the next call */
 };
 
 #define	EMSMDB_PCMSPOLLMAX		60000
 #define	EMSMDB_PCRETRY			6
 #define	EMSMDB_PCRETRYDELAY		10000
 
+/* Minimum size of an EcDoRpcExt2 response to compress */
+#define	EMSMDB_COMPRESS_THRESHOLD	1024
+
+/* Upper bound of a ROP response header, beyond the data it carries */
+#define	EMSMDB_CHAIN_ROP_OVERHEAD	32
+
+/* Largest ROP output buffer a client accepts in one extended buffer */
+#define	EMSMDB_ROP_BUFFER_SIZE		0x8000
+
+/* frightsVisible, missing from ACLRIGHTS where it is named RoleNone */
+#define	EMSMDBP_RIGHTS_FOLDER_VISIBLE	0x00000400
+
+/* Number of folder identifiers returned by a private RopLogon */
+#define	EMSMDBP_LOGON_RECORD_FOLDERS	13
+
+/* Search folder criteria, kept in openchangedb with the folder */
+#define	EMSMDBP_SEARCH_CRITERIA_PROPTAG	PROP_TAG(PT_BINARY, 0x3fe2)
+
+/* Search folder state returned by RopGetSearchCriteria */
+#define	EMSMDBP_SEARCH_RUNNING		0x00000001
+#define	EMSMDBP_SEARCH_REBUILD		0x00000002
+#define	EMSMDBP_SEARCH_RECURSIVE	0x00000004
+#define	EMSMDBP_SEARCH_COMPLETE		0x00001000
+#define	EMSMDBP_SEARCH_STATIC		0x00010000
+
+struct emsmdbp_search_member {
+	uint64_t		fid;
+	uint64_t		mid;
+};
+
+struct emsmdbp_search_change {
+	uint64_t		fid;
+	uint64_t		mid;	/* 0 to search the whole folder again */
+};
+
+struct emsmdbp_search_folder {
+	struct emsmdbp_search_folder	*prev;
+	struct emsmdbp_search_folder	*next;
+	char				*owner;
+	uint64_t			fid;
+	uint32_t			flags;		/* RECURSIVE_SEARCH, STOP_SEARCH and STATIC_SEARCH */
+	struct mapi_SRestriction	*res;
+	struct mapiproxy_restriction	*program;	/* NULL until criteria are set */
+	struct SPropTagArray		*proptags;	/* PidTagMid and the properties the restriction reads */
+	uint16_t			scope_count;
+	uint64_t			*scope;		/* folders given by the client */
+	uint32_t			folder_count;
+	uint64_t			*folders;	/* the scope with the subfolders of recursive searches */
+	bool				complete;	/* folders were searched in this session */
+	uint32_t			count;
+	struct emsmdbp_search_member	*members;
+	uint32_t			change_count;
+	struct emsmdbp_search_change	*changes;
+};
+
+enum emsmdbp_recipient_key {
+	EMSMDBP_RECIPIENT_BY_NAME,	/* part of the account name */
+	EMSMDBP_RECIPIENT_BY_X500	/* legacyExchangeDN */
+};
+
+/* The account attributes recipient rows are built from */
+struct emsmdbp_recipient {
+	char			*account;		/* sAMAccountName */
+	char			*display_name;		/* displayName */
+	char			*nickname;		/* mailNickname */
+	char			*legacyExchangeDN;
+};
+
+struct emsmdbp_logon_record {
+	uint32_t		version;
+	time_t			verified;
+	uint64_t		folders[EMSMDBP_LOGON_RECORD_FOLDERS];
+	struct GUID		MailboxGuid;
+	uint16_t		ReplId;
+	struct GUID		ReplGUID;
+};
+
 enum emsmdbp_mailbox_systemidx {
 	EMSMDBP_MAILBOX_ROOT = 1,
 	EMSMDBP_DEFERRED_ACTION,
@@ -294,10 +553,64 @@ struct emsmdbp_special_folder {
 
 #define PROVISIONING_SPECIAL_FOLDERS_SIZE 6
 #define PROVISIONING_FOLDERS_SIZE EMSMDBP_DELETED_ITEMS
+
+#define	EMSMDBP_STATS_ROPS		256
+#define	EMSMDBP_STATS_BUCKETS		24
+#define	EMSMDBP_STATS_SESSIONS		256
+#define	EMSMDBP_STATS_MAGIC		0x4f435354
+#define	EMSMDBP_STATS_OBJECT_TYPES	16
+#define	EMSMDBP_STATS_VERSION		3
+
+/* Counters of a ROP, latencies are in microseconds */
+struct emsmdbp_rop_stats {
+	uint64_t			count;
+	uint64_t			errors;
+	uint64_t			total_usec;
+	uint64_t			max_usec;
+	uint64_t			buckets[EMSMDBP_STATS_BUCKETS];
+};
+
+/* Memory gauge of a session, the slot is free when in_use is 0 */
+struct emsmdbp_session_stats {
+	uint32_t			in_use;
+	uint32_t			state;
+	uint64_t			size;
+	uint64_t			peak;
+	char				username[64];
+};
+
+/* Objects of a type: alive and created since the worker started */
+struct emsmdbp_object_stats {
+	uint64_t			live;
+	uint64_t			created;
+};
+
+/* Layout of the emsmdb-<pid>.stats file of a worker */
+struct emsmdbp_stats {
+	uint32_t			magic;
+	uint32_t			version;
+	uint32_t			pid;
+	uint32_t			buckets;
+	uint64_t			started;
+	struct emsmdbp_rop_stats	rops[EMSMDBP_STATS_ROPS];
+	struct emsmdbp_session_stats	sessions[EMSMDBP_STATS_SESSIONS];
+	struct emsmdbp_object_stats	objects[EMSMDBP_STATS_OBJECT_TYPES];
+};
+
 __BEGIN_DECLS
 
 NTSTATUS	samba_init_module(void);
-struct ldb_context *samdb_connect_url(TALLOC_CTX *, struct tevent_context *, struct loadparm_context *, struct auth_session_info *, unsigned int, const char *);
+
+/* definitions from dcesrv_exchange_emsmdb.c */
+uint32_t		dcesrv_emsmdb_session_count(void);
+bool			emsmdb_mapihttp_init(struct loadparm_context *);
+enum MAPISTATUS		emsmdb_mapihttp_connect(TALLOC_CTX *, struct loadparm_context *, struct tevent_context *, const char *, const char *, uint32_t, struct server_id, uint32_t, struct GUID *, const char **, const char **);
+enum MAPISTATUS		emsmdb_mapihttp_execute(TALLOC_CTX *, const struct GUID *, const char *, DATA_BLOB *, uint32_t, uint32_t, DATA_BLOB *);
+enum MAPISTATUS		emsmdb_mapihttp_notification_pending(const struct GUID *, const char *, bool *);
+enum MAPISTATUS		emsmdb_mapihttp_disconnect(const struct GUID *, const char *);
+
+/* definitions from emsmdbp_mapihttp.c */
+bool			emsmdbp_mapihttp_start(struct loadparm_context *);
 
 /* definitions from emsmdbp.c */
 struct emsmdbp_context	*emsmdbp_init(struct loadparm_context *, const char *, void *);
@@ -305,6 +618,7 @@ bool			emsmdbp_set_session_uuid(struct emsmdbp_context *, struct GUID);
 void			*emsmdbp_openchangedb_init(struct loadparm_context *);
 bool			emsmdbp_destructor(void *);
 bool			emsmdbp_verify_user(struct dcesrv_call_state *, struct emsmdbp_context *);
+bool			emsmdbp_verify_username(struct emsmdbp_context *, const char *);
 bool			emsmdbp_verify_userdn(struct dcesrv_call_state *, struct emsmdbp_context *, const char *, struct ldb_message **);
 enum MAPISTATUS		emsmdbp_resolve_recipient(TALLOC_CTX *, struct emsmdbp_context *, char *, struct mapi_SPropTagArray *, struct RecipientRow *);
 enum MAPISTATUS		emsmdbp_fetch_organizational_units(TALLOC_CTX *, struct emsmdbp_context *, char **, char **);
@@ -314,6 +628,67 @@ const struct GUID *const	MagicGUIDp;
 int				emsmdbp_guid_to_replid(struct emsmdbp_context *, const char *username, const struct GUID *, uint16_t *);
 int				emsmdbp_replid_to_guid(struct emsmdbp_context *, const char *username, const uint16_t, struct GUID *);
 int				emsmdbp_source_key_from_fmid(TALLOC_CTX *, struct emsmdbp_context *, const char *username, uint64_t, struct Binary_r **);
+void				emsmdbp_change_numbers_begin(struct emsmdbp_context *);
+void				emsmdbp_change_numbers_end(struct emsmdbp_context *);
+enum MAPISTATUS			emsmdbp_change_number(struct emsmdbp_context *, const char *, uint64_t *);
+
+/* definitions from emsmdbp_stats.c */
+bool		emsmdbp_stats_init(struct loadparm_context *);
+bool		emsmdbp_stats_enabled(void);
+void		emsmdbp_stats_start(struct timespec *);
+void		emsmdbp_stats_rop(uint8_t, bool, const struct timespec *);
+struct emsmdbp_session_stats	*emsmdbp_stats_session_get(const char *);
+void		emsmdbp_stats_session_release(struct emsmdbp_session_stats *);
+void		emsmdbp_stats_object(enum emsmdbp_object_type, bool);
+
+/* definitions from emsmdbp_memory.c */
+enum emsmdbp_memory_state	emsmdbp_memory_sample(struct emsmdbp_context *);
+uint32_t	emsmdbp_memory_buffer_size(struct emsmdbp_context *, uint32_t);
+void		emsmdbp_memory_release(struct emsmdbp_context *);
+
+/* definitions from emsmdbp_idle.c */
+void		emsmdbp_idle_touch(struct emsmdbp_context *);
+void		emsmdbp_idle_hibernate(struct emsmdbp_context *);
+void		emsmdbp_idle_release(struct emsmdbp_context *);
+
+/* definitions from emsmdbp_threads.c */
+bool		emsmdbp_threads_init(struct loadparm_context *, struct tevent_context *);
+bool		emsmdbp_threads_enabled(void);
+bool		emsmdbp_threads_run(struct server_id, uint32_t, void (*)(void *), void (*)(void *), void *);
+void		emsmdbp_threads_lock(void);
+void		emsmdbp_threads_unlock(void);
+uint32_t	emsmdbp_threads_queue_depth(void);
+void		emsmdbp_threads_set_bulk(void);
+
+/* definitions from emsmdbp_sched.c */
+void		emsmdbp_sched_begin(struct emsmdbp_context *);
+bool		emsmdbp_sched_yield(struct emsmdbp_context *);
+bool		emsmdbp_sched_bulk_rop(const struct EcDoRpc_MAPI_REQ *);
+
+/* definitions from emsmdbp_load.c */
+bool		emsmdbp_load_begin(struct loadparm_context *);
+void		emsmdbp_load_end(void);
+void		emsmdbp_load_rop(const struct timespec *);
+uint32_t	emsmdbp_load_backoff(const struct EcDoRpc_MAPI_REQ *);
+
+/* definitions from emsmdbp_deferred.c */
+enum mapistore_error	emsmdbp_deferred_delete_indexing_records(struct emsmdbp_context *, uint32_t, char *, uint64_t, uint64_t *, uint32_t, uint8_t);
+void			emsmdbp_deferred_delete_flush(struct emsmdbp_context *);
+
+/* definitions from emsmdbp_submit.c */
+bool			emsmdbp_submit_queue(struct emsmdbp_context *, struct emsmdbp_object *, uint8_t);
+void			emsmdbp_submit_flush(struct emsmdbp_context *);
+
+/* definitions from emsmdbp_category.c */
+enum MAPISTATUS emsmdbp_object_table_categorize(struct emsmdbp_context *, struct emsmdbp_object *, struct SSortOrderSet *);
+enum MAPISTATUS emsmdbp_object_table_categories_refresh(struct emsmdbp_context *, struct emsmdbp_object *, bool);
+void emsmdbp_object_table_categories_reset(struct emsmdbp_object_table *);
+struct emsmdbp_table_category *emsmdbp_object_table_category_find(struct emsmdbp_object_table *, uint64_t);
+bool emsmdbp_object_table_category_locate(struct emsmdbp_object_table *, uint32_t, struct emsmdbp_table_category **, uint32_t *);
+bool emsmdbp_object_table_category_fill_row(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, DATA_BLOB *);
+enum MAPISTATUS emsmdbp_object_table_category_set_expanded(struct emsmdbp_object_table *, struct emsmdbp_table_category *, bool, uint32_t *);
+enum MAPISTATUS emsmdbp_object_table_categories_get_state(TALLOC_CTX *, struct emsmdbp_object_table *, uint64_t, struct SBinary_short *);
+enum MAPISTATUS emsmdbp_object_table_categories_set_state(struct emsmdbp_object_table *, const struct SBinary_short *);
 
 /* definitions from emsmdbp_object.c */
 const char	      *emsmdbp_getstr_type(struct emsmdbp_object *);
@@ -325,9 +700,75 @@ int		      emsmdbp_get_uri_from_fid(TALLOC_CTX *, struct emsmdbp_context *, uint
 int		      emsmdbp_get_fid_from_uri(struct emsmdbp_context *, const char *, uint64_t *);
 uint32_t	      emsmdbp_get_contextID(struct emsmdbp_object *);
 
+/* definitions from emsmdbp_propset.c */
+struct emsmdbp_propset	*emsmdbp_propset_get(TALLOC_CTX *, struct emsmdbp_context *, uint16_t, const enum MAPITAGS *);
+struct SPropTagArray	*emsmdbp_propset_copy_tags(TALLOC_CTX *, const struct emsmdbp_propset *);
+
+/* definitions from emsmdbp_syncstate.c */
+struct idset	*emsmdbp_syncstate_lookup(TALLOC_CTX *, struct emsmdbp_context *, uint32_t, const DATA_BLOB *);
+void		emsmdbp_syncstate_store(struct emsmdbp_context *, uint32_t, const DATA_BLOB *, const struct idset *);
+
+/* definitions from emsmdbp_folder_cache.c */
+bool			emsmdbp_folder_cache_get_parent(struct emsmdbp_context *, const char *, uint64_t, uint64_t *);
+void			emsmdbp_folder_cache_set_parent(struct emsmdbp_context *, const char *, uint64_t, uint64_t);
+struct emsmdbp_object	*emsmdbp_folder_cache_get_object(struct emsmdbp_context *, const char *, uint64_t);
+void			emsmdbp_folder_cache_set_object(struct emsmdbp_context *, const char *, struct emsmdbp_object *);
+void			emsmdbp_folder_cache_forget_object(struct emsmdbp_object *);
+void			emsmdbp_folder_cache_reset(struct emsmdbp_context *);
+void			emsmdbp_folder_cache_notify(struct emsmdbp_context *, const struct Notify_repl *);
+
+/* definitions from emsmdbp_replica_cache.c */
+bool			emsmdbp_replica_cache_get_guid(struct emsmdbp_context *, const char *, uint16_t, struct GUID *);
+bool			emsmdbp_replica_cache_get_replid(struct emsmdbp_context *, const char *, const struct GUID *, uint16_t *);
+void			emsmdbp_replica_cache_set(struct emsmdbp_context *, const char *, uint16_t, const struct GUID *);
+
+/* definitions from emsmdbp_message_counts.c */
+enum MAPISTATUS	emsmdbp_message_counts_get_folder(struct emsmdbp_context *, struct emsmdbp_object *, struct openchangedb_message_counts *);
+void		emsmdbp_message_counts_track(struct emsmdbp_context *, struct emsmdbp_object *, bool);
+void		emsmdbp_message_counts_folder_changed(struct emsmdbp_context *, struct emsmdbp_object *);
+void		emsmdbp_message_counts_message_changed(struct emsmdbp_context *, struct emsmdbp_object *);
+void		emsmdbp_message_counts_notify(struct emsmdbp_context *, const struct Notify_repl *);
+
+/* definitions from emsmdbp_logon.c */
+enum MAPISTATUS	emsmdbp_logon_record_get(struct emsmdbp_context *, const char *, const char *, struct emsmdbp_logon_record *);
+void		emsmdbp_logon_record_invalidate(struct emsmdbp_context *, const char *);
+
+/* definitions from emsmdbp_recipients.c */
+enum MAPISTATUS	emsmdbp_recipient_resolve(TALLOC_CTX *, struct emsmdbp_context *, enum emsmdbp_recipient_key, const char *, struct emsmdbp_recipient **);
+
+/* definitions from emsmdbp_acl.c */
+enum MAPISTATUS	emsmdbp_acl_get_rights(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t *);
+enum MAPISTATUS	emsmdbp_acl_check(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t);
+void		emsmdbp_acl_cache_invalidate(struct emsmdbp_context *, const char *);
+
+/* definitions from emsmdbp_search.c */
+enum MAPISTATUS	emsmdbp_search_get(struct emsmdbp_context *, struct emsmdbp_object *, struct emsmdbp_search_folder **);
+enum MAPISTATUS	emsmdbp_search_set_criteria(struct emsmdbp_context *, struct emsmdbp_object *, const struct SetSearchCriteria_req *);
+uint32_t	emsmdbp_search_get_state(const struct emsmdbp_search_folder *);
+void		emsmdbp_search_table_refresh(struct emsmdbp_context *, struct emsmdbp_object *);
+void		**emsmdbp_search_get_row_props(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, enum MAPISTATUS **);
+void		emsmdbp_search_message_changed(struct emsmdbp_context *, uint64_t, uint64_t);
+void		emsmdbp_search_message_saved(struct emsmdbp_context *, struct emsmdbp_object *);
+void		emsmdbp_search_message_removed(struct emsmdbp_context *, uint64_t, uint64_t);
+void		emsmdbp_search_notify(struct emsmdbp_context *, const struct Notify_repl *);
+
+/* definitions from emsmdbp_conversations.c */
+void		emsmdbp_conversation_id(const char *, uint8_t *);
+bool		emsmdbp_conversation_column(enum MAPITAGS);
+void		emsmdbp_conversations_message_saved(struct emsmdbp_context *, struct emsmdbp_object *);
+void		emsmdbp_conversations_messages_copied(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, const uint64_t *, const uint64_t *, bool);
+void		emsmdbp_conversations_messages_deleted(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, const uint64_t *);
+
+/* definitions from emsmdbp_content_index.c */
+enum MAPISTATUS	emsmdbp_content_index_candidates(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, const struct mapi_SRestriction *, uint64_t **, uint32_t *);
+void		emsmdbp_content_index_message_saved(struct emsmdbp_context *, struct emsmdbp_object *);
+void		emsmdbp_content_index_message_changed(struct emsmdbp_context *, struct emsmdbp_object *, uint64_t);
+void		emsmdbp_content_index_messages_deleted(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, const uint64_t *);
+
 /* definitions from emsmdbp_provisioning.c */
 enum MAPISTATUS       emsmdbp_mailbox_provision(struct emsmdbp_context *, const char *);
 enum MAPISTATUS       emsmdbp_mailbox_provision_public_freebusy(struct emsmdbp_context *, const char *);
+void                  emsmdbp_mailbox_provision_invalidate(struct emsmdbp_context *, const char *);
 
 /* definitions from emsmdbp_provisioning_names.c */
 const char **emsmdbp_get_folders_names(TALLOC_CTX *, struct emsmdbp_context *);
@@ -338,6 +779,7 @@ enum mapistore_error  emsmdbp_object_get_fid_by_name(struct emsmdbp_context *, s
 enum MAPISTATUS       emsmdbp_object_create_folder(struct emsmdbp_context *, struct emsmdbp_object *, TALLOC_CTX *, uint64_t, struct SRow *, bool, struct emsmdbp_object **);
 enum mapistore_error  emsmdbp_object_open_folder(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint64_t, struct emsmdbp_object **);
 enum MAPISTATUS       emsmdbp_object_open_folder_by_fid(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint64_t, struct emsmdbp_object **);
+enum mapistore_error  emsmdbp_object_reopen(struct emsmdbp_context *, struct emsmdbp_object *);
 
 struct emsmdbp_object *emsmdbp_object_init(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *parent_object);
 int emsmdbp_object_copy_properties(struct emsmdbp_context *, struct emsmdbp_object *, struct emsmdbp_object *, struct SPropTagArray *, bool);
@@ -346,19 +788,40 @@ struct emsmdbp_object *emsmdbp_object_mailbox_init(TALLOC_CTX *, struct emsmdbp_
 struct emsmdbp_object *emsmdbp_object_folder_init(TALLOC_CTX *, struct emsmdbp_context *, uint64_t, struct emsmdbp_object *);
 enum MAPISTATUS      emsmdbp_folder_get_folder_count(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t *);
 enum MAPISTATUS emsmdbp_folder_get_recursive_folder_count(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t *);
+void emsmdbp_folder_update_recursive_counts(struct emsmdbp_context *, struct emsmdbp_object *, uint64_t, uint64_t, int32_t, bool);
+void emsmdbp_folder_hierarchy_changed(struct emsmdbp_context *, struct emsmdbp_object *, uint64_t);
 enum mapistore_error emsmdbp_folder_delete_indexing_records(struct mapistore_context *, uint32_t, char *, uint64_t, uint64_t *, uint32_t, uint8_t);
 enum mapistore_error emsmdbp_folder_delete(struct emsmdbp_context *, struct emsmdbp_object *, uint64_t, uint8_t);
 enum mapistore_error emsmdbp_folder_move_folder(struct emsmdbp_context *, struct emsmdbp_object *, struct emsmdbp_object *, TALLOC_CTX *, const char *);
+enum mapistore_error emsmdbp_folder_move_copy_messages(struct emsmdbp_context *, struct emsmdbp_object *, struct emsmdbp_object *, TALLOC_CTX *, uint32_t, uint64_t *, bool, bool *);
 struct emsmdbp_object *emsmdbp_folder_open_table(TALLOC_CTX *, struct emsmdbp_object *, uint32_t, uint32_t);
 struct emsmdbp_object *emsmdbp_object_table_init(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *);
 int emsmdbp_object_table_get_available_properties(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, struct SPropTagArray **);
 void **emsmdbp_object_table_get_row_props(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, enum mapistore_query_type, enum MAPISTATUS **);
+bool emsmdbp_object_table_row_match(struct emsmdbp_object_table *, const struct mapiproxy_restriction *, void **, enum MAPISTATUS *);
+struct emsmdbp_table_row_props *emsmdbp_object_table_get_rows_props(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, uint32_t, enum mapistore_query_type, uint32_t *);
+void emsmdbp_object_table_cache_reset(struct emsmdbp_object_table *);
+void emsmdbp_object_table_cache_validate(struct emsmdbp_context *, struct emsmdbp_object_table *, uint32_t);
+bool emsmdbp_object_table_cache_fetch(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object_table *, uint32_t, DATA_BLOB *);
+void emsmdbp_object_table_cache_store(struct emsmdbp_context *, struct emsmdbp_object_table *, uint32_t, const uint8_t *, size_t);
+enum MAPISTATUS emsmdbp_object_table_bookmark_create(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, struct SBinary_short *);
+struct emsmdbp_table_bookmark *emsmdbp_object_table_bookmark_find(struct emsmdbp_object_table *, const struct SBinary_short *);
+bool emsmdbp_object_table_bookmark_locate(struct emsmdbp_context *, struct emsmdbp_object *, struct emsmdbp_table_bookmark *, uint32_t *);
+void emsmdbp_object_table_bookmarks_reset(struct emsmdbp_object_table *);
+enum MAPISTATUS emsmdbp_object_table_get_folder_tree_rows(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, DATA_BLOB *, struct SPropTagArray *, int64_t *, uint32_t *);
 enum MAPISTATUS emsmdbp_object_table_get_recursive_row_props(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, DATA_BLOB *, struct SPropTagArray *, uint64_t, int64_t *, uint32_t *);
+void emsmdbp_freebusy_message_saved(struct emsmdbp_object *);
+void emsmdbp_freebusy_messages_deleted(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, const uint64_t *);
+void emsmdbp_freebusy_folder_changed(struct emsmdbp_context *, struct emsmdbp_object *);
+void emsmdbp_tombstones_messages_deleted(struct emsmdbp_context *, struct emsmdbp_object *, uint32_t, const uint64_t *);
 struct emsmdbp_object *emsmdbp_object_message_init(TALLOC_CTX *, struct emsmdbp_context *, uint64_t, struct emsmdbp_object *);
 enum mapistore_error emsmdbp_object_message_open(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, uint64_t, uint64_t, bool, struct emsmdbp_object **, struct mapistore_message **);
+void emsmdbp_object_message_prefetch(struct emsmdbp_context *, struct emsmdbp_object *);
+enum mapistore_error emsmdbp_object_message_flush_properties(struct emsmdbp_context *, struct emsmdbp_object *);
 struct emsmdbp_object *emsmdbp_object_message_open_attachment_table(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *);
 struct emsmdbp_object *emsmdbp_object_stream_init(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *);
 int emsmdbp_object_stream_commit(struct emsmdbp_object *);
+uint64_t emsmdbp_object_stream_get_size(struct emsmdbp_object_stream *);
 struct emsmdbp_object *emsmdbp_object_attachment_init(TALLOC_CTX *, struct emsmdbp_context *, uint64_t, struct emsmdbp_object *);
 struct emsmdbp_object *emsmdbp_object_subscription_init(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *);
 int emsmdbp_object_get_available_properties(TALLOC_CTX *, struct emsmdbp_context *, struct emsmdbp_object *, struct SPropTagArray **);
@@ -396,8 +859,10 @@ enum MAPISTATUS EcDoRpc_RopCreateMessage(TALLOC_CTX *, struct emsmdbp_context *,
 enum MAPISTATUS EcDoRpc_RopSaveChangesMessage(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopRemoveAllRecipients(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopModifyRecipients(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopReadRecipients(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopReloadCachedInformation(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopSetMessageReadFlag(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopSetReadFlags(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopGetMessageStatus(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopGetAttachmentTable(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopOpenAttach(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
@@ -446,10 +911,18 @@ enum MAPISTATUS EcDoRpc_RopRestrict(TALLOC_CTX *, struct emsmdbp_context *, stru
 enum MAPISTATUS EcDoRpc_RopQueryRows(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopQueryPosition(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopSeekRow(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopSeekRowBookmark(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopCreateBookmark(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopResetTable(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopFreeBookmark(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopExpandRow(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopCollapseRow(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopGetCollapseState(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+enum MAPISTATUS EcDoRpc_RopSetCollapseState(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 
 /* definition from oxomsg.c */
+void		oxomsg_mapistore_handle_message_relocation(struct emsmdbp_context *, struct emsmdbp_object *);
 enum MAPISTATUS	EcDoRpc_RopSubmitMessage(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS	EcDoRpc_RopSetSpooler(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS	EcDoRpc_RopGetAddressTypes(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
@@ -481,6 +954,9 @@ enum MAPISTATUS EcDoRpc_RopGetLocalReplicaIds(TALLOC_CTX *, struct emsmdbp_conte
 enum MAPISTATUS EcDoRpc_RopSyncImportReadStateChanges(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopSyncGetTransferState(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
 enum MAPISTATUS EcDoRpc_RopSetLocalReplicaMidsetDeleted(TALLOC_CTX *, struct emsmdbp_context *, struct EcDoRpc_MAPI_REQ *, struct EcDoRpc_MAPI_REPL *, uint32_t *, uint16_t *);
+struct emsmdbp_stream_segments *oxcfxics_stream_segments_init(TALLOC_CTX *);
+void oxcfxics_stream_segment_push(struct emsmdbp_stream_segments *, uint32_t, uint32_t);
+uint32_t oxcfxics_stream_segments_slice(struct emsmdbp_stream_segments *, size_t, uint32_t);
 
 /* definition from oxosfld.c */
 bool oxosfld_is_special_folder(struct emsmdbp_context *, uint64_t);
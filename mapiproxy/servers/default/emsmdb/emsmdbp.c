@@ -33,15 +33,6 @@
 
 #include <ldap_ndr.h>
 
-/* Expose samdb_connect prototype */
-struct ldb_context *samdb_connect(TALLOC_CTX *, struct tevent_context *,
-				  struct loadparm_context *,
-				  struct auth_session_info *,
-				  unsigned int);
-
-/* Single connection to samdb */
-static struct ldb_context *samdb_ctx = NULL;
-
 static struct GUID MagicGUID = {
 	.time_low = 0xbeefface,
 	.time_mid = 0xcafe,
@@ -51,41 +42,6 @@ static struct GUID MagicGUID = {
 };
 const struct GUID *const MagicGUIDp = &MagicGUID;
 
-/**
-   \details Initialize ldb_context to samdb, creates one for all emsmdbp
-   contexts
-
-   \param lp_ctx pointer to the loadparm context
- */
-static struct ldb_context *samdb_init(struct loadparm_context *lp_ctx)
-{
-	TALLOC_CTX		*mem_ctx;
-	struct tevent_context	*ev;
-	const char		*samdb_url;
-
-	if (samdb_ctx) return samdb_ctx;
-
-	mem_ctx = talloc_autofree_context();
-	ev = tevent_context_init(mem_ctx);
-	if (!ev) {
-		OC_PANIC(false, ("Fail to initialize tevent_context\n"));
-		return NULL;
-	}
-	tevent_loop_allow_nesting(ev);
-
-	/* Retrieve samdb url (local or external) */
-	samdb_url = lpcfg_parm_string(lp_ctx, NULL, "dcerpc_mapiproxy", "samdb_url");
-
-	if (!samdb_url) {
-		samdb_ctx = samdb_connect(mem_ctx, ev, lp_ctx, system_session(lp_ctx), 0);
-	} else {
-		samdb_ctx = samdb_connect_url(mem_ctx, ev, lp_ctx, system_session(lp_ctx),
-					      LDB_FLG_RECONNECT, samdb_url);
-	}
-
-	return samdb_ctx;
-}
-
 /**
    \details Release the MAPISTORE context used by EMSMDB provider
    context
@@ -128,7 +84,8 @@ static int emsmdbp_mapi_handles_destructor(void *data)
 
    \param lp_ctx pointer to the loadparm_context
    \param username account name for current session
-   \param ldb_ctx pointer to the openchange dispatcher ldb database
+   \param oc_ctx pointer to the openchange dispatcher database used
+   when the organization of the user has no database of its own
 
    \return Allocated emsmdbp_context pointer on success, otherwise
    NULL
@@ -140,6 +97,8 @@ _PUBLIC_ struct emsmdbp_context *emsmdbp_init(struct loadparm_context *lp_ctx,
 	TALLOC_CTX		*mem_ctx;
 	struct emsmdbp_context	*emsmdbp_ctx;
 	enum mapistore_error	ret;
+	void			*stats_area;
+	size_t			stats_size;
 
 	/* Sanity Checks */
 	if (!lp_ctx) return NULL;
@@ -157,15 +116,31 @@ _PUBLIC_ struct emsmdbp_context *emsmdbp_init(struct loadparm_context *lp_ctx,
 	/* Save a pointer to the loadparm context */
 	emsmdbp_ctx->lp_ctx = lp_ctx;
 
-	emsmdbp_ctx->samdb_ctx = samdb_init(lp_ctx);
+	emsmdbp_ctx->samdb_ctx = mapiproxy_server_samdb_init(lp_ctx);
 	if (!emsmdbp_ctx->samdb_ctx) {
 		talloc_free(mem_ctx);
 		OC_DEBUG(0, "Connection to \"sam.ldb\" failed\n");
 		return NULL;
 	}
 
-	/* Reference global OpenChange dispatcher database pointer within current context */
+	/* Reference global OpenChange dispatcher database pointer within
+	   current context, unless the organization of the user has its own */
 	emsmdbp_ctx->oc_ctx = oc_ctx;
+	if (lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "openchangedb_tenants", false)) {
+		emsmdbp_ctx->oc_ctx = mapiproxy_server_openchangedb_user_init(lp_ctx, username);
+		if (!emsmdbp_ctx->oc_ctx) {
+			OC_DEBUG(0, "No openchangedb available for %s\n", username);
+			talloc_free(mem_ctx);
+			return NULL;
+		}
+	}
+
+	/* Backend and indexing counters go to the runtime statistics
+	   of the process too */
+	if (mapiproxy_stats_init(lp_ctx)) {
+		stats_area = mapiproxy_stats_mapistore_area(&stats_size);
+		mapistore_set_shared_stats(stats_area, stats_size);
+	}
 
 	/* Initialize the mapistore context */
 	emsmdbp_ctx->mstore_ctx = mapistore_init(mem_ctx, lp_ctx, NULL);
@@ -192,6 +167,10 @@ _PUBLIC_ struct emsmdbp_context *emsmdbp_init(struct loadparm_context *lp_ctx,
 	}
 	talloc_set_destructor((void *)emsmdbp_ctx->handles_ctx, (int (*)(void *))emsmdbp_mapi_handles_destructor);
 
+	if (lpcfg_parm_bool(lp_ctx, NULL, "mapiproxy", "handles_tdb_mirror", false)) {
+		mapi_handles_set_tdb_mirror(emsmdbp_ctx->handles_ctx, true);
+	}
+
 	return emsmdbp_ctx;
 }
 
@@ -237,6 +216,13 @@ _PUBLIC_ bool emsmdbp_destructor(void *data)
 
 	if (!emsmdbp_ctx) return false;
 
+	emsmdbp_submit_flush(emsmdbp_ctx);
+	emsmdbp_deferred_delete_flush(emsmdbp_ctx);
+	emsmdbp_memory_release(emsmdbp_ctx);
+	emsmdbp_idle_release(emsmdbp_ctx);
+	if (!GUID_all_zero(&emsmdbp_ctx->session_uuid)) {
+		mapistore_notification_bus_unsubscribe(emsmdbp_ctx->mstore_ctx, emsmdbp_ctx->session_uuid);
+	}
 	talloc_unlink(emsmdbp_ctx, emsmdbp_ctx->oc_ctx);
 	talloc_free(emsmdbp_ctx->mem_ctx);
 
@@ -257,14 +243,30 @@ _PUBLIC_ bool emsmdbp_destructor(void *data)
  */
 _PUBLIC_ bool emsmdbp_verify_user(struct dcesrv_call_state *dce_call,
 				  struct emsmdbp_context *emsmdbp_ctx)
+{
+	return emsmdbp_verify_username(emsmdbp_ctx, dcesrv_call_account_name(dce_call));
+}
+
+
+/**
+   \details Check if a user authenticated outside of DCE/RPC belongs to
+   the Exchange organization and is enabled
+
+   \param emsmdbp_ctx pointer to the EMSMDBP context
+   \param username the account name of the user
+
+   \return true on success, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_verify_username(struct emsmdbp_context *emsmdbp_ctx,
+				      const char *username)
 {
 	int			ret;
-	const char		*username = NULL;
 	int			msExchUserAccountControl;
 	struct ldb_result	*res = NULL;
 	const char * const	recipient_attrs[] = { "msExchUserAccountControl", NULL };
 
-	username = dcesrv_call_account_name(dce_call);
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !username) return false;
 
 	ret = ldb_search(emsmdbp_ctx->samdb_ctx, emsmdbp_ctx, &res,
 			 ldb_get_default_basedn(emsmdbp_ctx->samdb_ctx),
@@ -368,18 +370,16 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_resolve_recipient(TALLOC_CTX *mem_ctx,
 						   struct mapi_SPropTagArray *properties,
 						   struct RecipientRow *row)
 {
-	enum MAPISTATUS		retval;
-	struct ldb_result	*res = NULL;
-	const char * const	recipient_attrs[] = { "*", NULL };
-	int			ret;
-	uint32_t		i;
-	uint32_t		property = 0;
-	void			*data;
-	char			*str;
-	char			*username;
-	char			*legacyExchangeDN;
-	uint32_t		org_length;
-	uint32_t		l;
+	enum MAPISTATUS			retval;
+	struct emsmdbp_recipient	*resolved = NULL;
+	uint32_t			i;
+	uint32_t			property = 0;
+	void				*data;
+	char				*str;
+	char				*username;
+	char				*legacyExchangeDN;
+	uint32_t			org_length;
+	uint32_t			l;
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_INITIALIZED, NULL);
@@ -389,14 +389,10 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_resolve_recipient(TALLOC_CTX *mem_ctx,
 	OPENCHANGE_RETVAL_IF(!recipient, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!row, MAPI_E_INVALID_PARAMETER, NULL);
 
-	ret = ldb_search(emsmdbp_ctx->samdb_ctx, emsmdbp_ctx, &res,
-			 ldb_get_default_basedn(emsmdbp_ctx->samdb_ctx),
-			 LDB_SCOPE_SUBTREE, recipient_attrs,
-			 "(&(objectClass=user)(sAMAccountName=*%s*)(!(objectClass=computer)))",
-			 ldb_binary_encode_string(mem_ctx, recipient));
+	retval = emsmdbp_recipient_resolve(mem_ctx, emsmdbp_ctx, EMSMDBP_RECIPIENT_BY_NAME, recipient, &resolved);
 
 	/* If the search failed, build an external recipient: very basic for the moment */
-	if (ret != LDB_SUCCESS || !res->count) {
+	if (retval != MAPI_E_SUCCESS) {
 	failure:
 		row->RecipientFlags = 0x07db;
 		row->EmailAddress.lpszW = talloc_strdup(mem_ctx, recipient);
@@ -428,8 +424,8 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_resolve_recipient(TALLOC_CTX *mem_ctx,
 
 	/* Otherwise build a RecipientRow for resolved username */
 
-	username = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "mailNickname", NULL);
-	legacyExchangeDN = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "legacyExchangeDN", NULL);
+	username = resolved->nickname;
+	legacyExchangeDN = resolved->legacyExchangeDN;
 	if (!username || !legacyExchangeDN) {
 		OC_DEBUG(0, "record found but mailNickname or legacyExchangeDN is missing for %s\n", recipient);
 		goto failure;
@@ -476,12 +472,12 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_resolve_recipient(TALLOC_CTX *mem_ctx,
 			break;
 		case PidTagAddressBookDisplayNamePrintable:
 			property = properties->aulPropTag[i];
-			str = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "mailNickname", NULL);
+			str = resolved->nickname;
 			data = (void *) str;
 			break;
 		case PidTagSmtpAddress:
 			property = properties->aulPropTag[i];
-			str = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "legacyExchangeDN", NULL);
+			str = resolved->legacyExchangeDN;
 			data = (void *) str;
 			break;
 		default:
@@ -498,6 +494,77 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_resolve_recipient(TALLOC_CTX *mem_ctx,
 	return MAPI_E_SUCCESS;
 }
 
+/**
+   \details Share a change number between the changes of the ROP
+   about to be processed, see emsmdbp_change_number
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_change_numbers_begin(struct emsmdbp_context *emsmdbp_ctx)
+{
+	emsmdbp_change_numbers_end(emsmdbp_ctx);
+	emsmdbp_ctx->shared_cn_active = true;
+}
+
+
+/**
+   \details Forget the change number of the ROP processed
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_change_numbers_end(struct emsmdbp_context *emsmdbp_ctx)
+{
+	talloc_free(emsmdbp_ctx->shared_cn_owner);
+	emsmdbp_ctx->shared_cn_owner = NULL;
+	emsmdbp_ctx->shared_cn = 0;
+	emsmdbp_ctx->shared_cn_active = false;
+}
+
+
+/**
+   \details Return a change number for a change made by the current ROP
+
+   A ROP creating a folder raises the hierarchy change number of its
+   ancestors and may log deletions too: these changes share the change
+   number allocated by the first one rather than reserving one each on
+   the openchangedb server. It is only allocated once the ROP needs it
+   and forgotten when the ROP completes, so change numbers keep growing
+   in the order changes are made. Outside of a ROP, a new change number
+   is allocated on every call.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox changed
+   \param cn pointer to the change number to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_change_number(struct emsmdbp_context *emsmdbp_ctx, const char *owner, uint64_t *cn)
+{
+	enum MAPISTATUS	retval;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!owner, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!cn, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (emsmdbp_ctx->shared_cn_owner && !strcmp(emsmdbp_ctx->shared_cn_owner, owner)) {
+		*cn = emsmdbp_ctx->shared_cn;
+		return MAPI_E_SUCCESS;
+	}
+
+	retval = openchangedb_get_new_changeNumber(emsmdbp_ctx->oc_ctx, owner, cn);
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
+
+	if (emsmdbp_ctx->shared_cn_active) {
+		talloc_free(emsmdbp_ctx->shared_cn_owner);
+		emsmdbp_ctx->shared_cn_owner = talloc_strdup(emsmdbp_ctx, owner);
+		emsmdbp_ctx->shared_cn = *cn;
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
 _PUBLIC_ int emsmdbp_guid_to_replid(struct emsmdbp_context *emsmdbp_ctx, const char *username, const struct GUID *guidP, uint16_t *replidP)
 {
 	uint16_t	replid;
@@ -508,13 +575,20 @@ _PUBLIC_ int emsmdbp_guid_to_replid(struct emsmdbp_context *emsmdbp_ctx, const c
 		return MAPI_E_SUCCESS;
 	}
 
-	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username, &replid, &guid);
-	if (GUID_equal(guidP, &guid)) {
-		*replidP = replid;
+	if (emsmdbp_replica_cache_get_replid(emsmdbp_ctx, username, guidP, replidP)) {
 		return MAPI_E_SUCCESS;
 	}
 
+	if (openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username, &replid, &guid) == MAPI_E_SUCCESS) {
+		emsmdbp_replica_cache_set(emsmdbp_ctx, username, replid, &guid);
+		if (GUID_equal(guidP, &guid)) {
+			*replidP = replid;
+			return MAPI_E_SUCCESS;
+		}
+	}
+
 	if (mapistore_replica_mapping_guid_to_replid(emsmdbp_ctx->mstore_ctx, username, guidP, &replid) == MAPISTORE_SUCCESS) {
+		emsmdbp_replica_cache_set(emsmdbp_ctx, username, replid, guidP);
 		*replidP = replid;
 		return MAPI_E_SUCCESS;
 	}
@@ -532,13 +606,20 @@ _PUBLIC_ int emsmdbp_replid_to_guid(struct emsmdbp_context *emsmdbp_ctx, const c
 		return MAPI_E_SUCCESS;
 	}
 
-	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username, &db_replid, &guid);
-	if (replid == db_replid) {
-		*guidP = guid;
+	if (emsmdbp_replica_cache_get_guid(emsmdbp_ctx, username, replid, guidP)) {
 		return MAPI_E_SUCCESS;
 	}
 
+	if (openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username, &db_replid, &guid) == MAPI_E_SUCCESS) {
+		emsmdbp_replica_cache_set(emsmdbp_ctx, username, db_replid, &guid);
+		if (replid == db_replid) {
+			*guidP = guid;
+			return MAPI_E_SUCCESS;
+		}
+	}
+
 	if (mapistore_replica_mapping_replid_to_guid(emsmdbp_ctx->mstore_ctx, username, replid, &guid) == MAPISTORE_SUCCESS) {
+		emsmdbp_replica_cache_set(emsmdbp_ctx, username, replid, &guid);
 		*guidP = guid;
 		return MAPI_E_SUCCESS;
 	}
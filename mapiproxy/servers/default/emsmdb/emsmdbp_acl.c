@@ -0,0 +1,306 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_acl.c
+
+   \brief Cached folder permissions
+
+   Folders and messages of a mailbox opened by another user (delegates,
+   shared folders) are only opened when the PidTagRights the backend
+   reports for the folder grant it. When emsmdb:acl_cache_ttl is set,
+   the rights of a user on a folder are kept in the worker process for
+   that many seconds instead of being read from the backend on every
+   open.
+
+   Cached rights carry the permissions version of the mailbox kept in
+   memcached. emsmdbp_acl_cache_invalidate bumps that version when the
+   permissions of a folder are modified, so every process reads them
+   again. Changes made outside OpenChange, such as group membership
+   changes, are only seen once the cached rights expire.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+#define	EMSMDBP_ACL_VERSION_KEY		"acl_version:%s"
+#define	EMSMDBP_ACL_CACHE_MAX		4096
+
+struct emsmdbp_acl_cache_entry {
+	struct emsmdbp_acl_cache_entry	*prev;
+	struct emsmdbp_acl_cache_entry	*next;
+	char				*owner;
+	char				*username;
+	uint64_t			fid;
+	uint32_t			rights;
+	uint32_t			version;
+	time_t				fetched;
+};
+
+/* Most recently used first */
+static struct emsmdbp_acl_cache_entry	*acl_cache = NULL;
+static uint32_t				acl_cache_count = 0;
+
+
+static memcached_st *emsmdbp_acl_memc(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx->mstore_ctx || !emsmdbp_ctx->mstore_ctx->notification_ctx) {
+		return NULL;
+	}
+	return emsmdbp_ctx->mstore_ctx->notification_ctx->memc_ctx;
+}
+
+
+/**
+   \details Retrieve the permissions version of a mailbox, 0 if none
+   was recorded or memcached is not available
+ */
+static uint32_t emsmdbp_acl_version(memcached_st *memc, const char *owner)
+{
+	memcached_return_t	rc;
+	char			*key, *value;
+	size_t			value_len;
+	uint32_t		flags, version = 0;
+
+	if (!memc) return 0;
+
+	key = talloc_asprintf(NULL, EMSMDBP_ACL_VERSION_KEY, owner);
+	if (!key) return 0;
+
+	value = memcached_get(memc, key, strlen(key), &value_len, &flags, &rc);
+	if (rc == MEMCACHED_SUCCESS && value) {
+		version = strtoul(value, NULL, 10);
+	}
+	free(value);
+	talloc_free(key);
+
+	return version;
+}
+
+
+static struct emsmdbp_acl_cache_entry *emsmdbp_acl_cache_find(const char *owner, uint64_t fid, const char *username)
+{
+	struct emsmdbp_acl_cache_entry	*entry;
+
+	for (entry = acl_cache; entry; entry = entry->next) {
+		if (entry->fid == fid && !strcmp(entry->username, username) && !strcmp(entry->owner, owner)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void emsmdbp_acl_cache_remove(struct emsmdbp_acl_cache_entry *entry)
+{
+	DLIST_REMOVE(acl_cache, entry);
+	talloc_free(entry);
+	acl_cache_count--;
+}
+
+
+static void emsmdbp_acl_cache_store(const char *owner, uint64_t fid, const char *username, uint32_t rights, uint32_t version)
+{
+	struct emsmdbp_acl_cache_entry	*entry;
+
+	entry = emsmdbp_acl_cache_find(owner, fid, username);
+	if (!entry) {
+		if (acl_cache_count >= EMSMDBP_ACL_CACHE_MAX) {
+			emsmdbp_acl_cache_remove(DLIST_TAIL(acl_cache));
+		}
+		entry = talloc_zero(NULL, struct emsmdbp_acl_cache_entry);
+		if (!entry) return;
+		entry->owner = talloc_strdup(entry, owner);
+		entry->username = talloc_strdup(entry, username);
+		if (!entry->owner || !entry->username) {
+			talloc_free(entry);
+			return;
+		}
+		entry->fid = fid;
+		DLIST_ADD(acl_cache, entry);
+		acl_cache_count++;
+	}
+	else {
+		DLIST_PROMOTE(acl_cache, entry);
+	}
+	entry->rights = rights;
+	entry->version = version;
+	entry->fetched = time(NULL);
+}
+
+
+/**
+   \details Read the rights of the logged on user on a folder from its
+   backend. Folders which do not report rights are not restricted.
+ */
+static uint32_t emsmdbp_acl_fetch_rights(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct SPropTagArray	props;
+	enum MAPITAGS		proptag = PidTagRights;
+	enum MAPISTATUS		*retvals = NULL;
+	void			**data_pointers;
+	uint32_t		rights = RoleOwner;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return rights;
+
+	props.cValues = 1;
+	props.aulPropTag = &proptag;
+	data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, folder, &props, &retvals);
+	if (data_pointers && retvals[0] == MAPI_E_SUCCESS && data_pointers[0]) {
+		rights = *(uint32_t *) data_pointers[0];
+	}
+	talloc_free(mem_ctx);
+
+	return rights;
+}
+
+
+/**
+   \details Retrieve the rights of the logged on user on a folder
+
+   The owner of the mailbox has all the rights on its folders. For
+   other users, the rights reported by the backend of mapistore folders
+   are used, from the cache when emsmdb:acl_cache_ttl is set.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder pointer to the folder object
+   \param rightsp pointer to the rights to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_acl_get_rights(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder, uint32_t *rightsp)
+{
+	struct emsmdbp_acl_cache_entry	*entry;
+	const char			*owner;
+	uint32_t			version;
+	int				ttl;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!folder || !rightsp, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(folder->type != EMSMDBP_OBJECT_FOLDER, MAPI_E_INVALID_PARAMETER, NULL);
+
+	/* openchangedb folders do not hold per-user rights */
+	owner = emsmdbp_get_owner(folder);
+	if (!emsmdbp_is_mapistore(folder) || !owner || !emsmdbp_ctx->username || !strcmp(owner, emsmdbp_ctx->username)) {
+		*rightsp = RoleOwner;
+		return MAPI_E_SUCCESS;
+	}
+
+	ttl = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "acl_cache_ttl", 0);
+	if (ttl <= 0) {
+		*rightsp = emsmdbp_acl_fetch_rights(emsmdbp_ctx, folder);
+		return MAPI_E_SUCCESS;
+	}
+
+	version = emsmdbp_acl_version(emsmdbp_acl_memc(emsmdbp_ctx), owner);
+
+	entry = emsmdbp_acl_cache_find(owner, folder->object.folder->folderID, emsmdbp_ctx->username);
+	if (entry && entry->version == version && time(NULL) - entry->fetched < ttl) {
+		DLIST_PROMOTE(acl_cache, entry);
+		*rightsp = entry->rights;
+		return MAPI_E_SUCCESS;
+	}
+
+	*rightsp = emsmdbp_acl_fetch_rights(emsmdbp_ctx, folder);
+	emsmdbp_acl_cache_store(owner, folder->object.folder->folderID, emsmdbp_ctx->username, *rightsp, version);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Check the logged on user holds the given rights on a folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder pointer to the folder object
+   \param rights the rights required, any of them is enough
+
+   \return MAPI_E_SUCCESS when granted, MAPI_E_NO_ACCESS when denied,
+   otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_acl_check(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder, uint32_t rights)
+{
+	enum MAPISTATUS		retval;
+	uint32_t		granted;
+
+	retval = emsmdbp_acl_get_rights(emsmdbp_ctx, folder, &granted);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	if (!(granted & rights)) {
+		OC_DEBUG(5, "%s denied rights 0x%.8x on folder 0x%"PRIx64" (has 0x%.8x)", emsmdbp_ctx->username,
+			 rights, folder->object.folder->folderID, granted);
+		return MAPI_E_NO_ACCESS;
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Invalidate the cached rights on the folders of a mailbox,
+   in this process and, through memcached, in every other one
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox
+ */
+_PUBLIC_ void emsmdbp_acl_cache_invalidate(struct emsmdbp_context *emsmdbp_ctx, const char *owner)
+{
+	struct emsmdbp_acl_cache_entry	*entry, *next;
+	memcached_st			*memc;
+	memcached_return_t		rc;
+	uint64_t			value;
+	char				*key;
+
+	if (!emsmdbp_ctx || !owner) return;
+
+	for (entry = acl_cache; entry; entry = next) {
+		next = entry->next;
+		if (!strcmp(entry->owner, owner)) {
+			emsmdbp_acl_cache_remove(entry);
+		}
+	}
+
+	memc = emsmdbp_acl_memc(emsmdbp_ctx);
+	if (!memc) return;
+
+	key = talloc_asprintf(NULL, EMSMDBP_ACL_VERSION_KEY, owner);
+	if (!key) return;
+
+	rc = memcached_increment(memc, key, strlen(key), 1, &value);
+	if (rc == MEMCACHED_NOTFOUND) {
+		rc = memcached_add(memc, key, strlen(key), "1", 1, 0, 0);
+		/* Added by another process in the meantime */
+		if (rc == MEMCACHED_NOTSTORED) {
+			rc = memcached_increment(memc, key, strlen(key), 1, &value);
+		}
+	}
+	if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_STORED) {
+		OC_DEBUG(3, "unable to bump permissions version of %s: %s", owner, memcached_strerror(memc, rc));
+	}
+
+	talloc_free(key);
+}
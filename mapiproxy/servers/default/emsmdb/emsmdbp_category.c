@@ -0,0 +1,898 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_category.c
+
+   \brief Categorized views of contents tables
+
+   Backends only know about flat sorted tables. Since the category
+   columns lead the sort order, every category covers a contiguous
+   range of the backend table: the headers are computed with a single
+   scan of the category columns and leaf rows are only fetched from
+   the backend when they lie in an expanded category the client reads.
+ */
+
+#include <ctype.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "mapiproxy/libmapiserver/libmapiserver.h"
+#include "libmapi/property_tags.h"
+
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Number of rows fetched at once while scanning the category columns */
+#define	EMSMDBP_CATEGORY_SCAN_BATCH	256
+
+/* Serialized collapse state: cursor id, cursor position and id count */
+#define	EMSMDBP_CATEGORY_STATE_HEADER	16
+
+struct emsmdbp_category_state {
+	uint64_t	id;
+	bool		expanded;
+};
+
+static bool emsmdbp_category_default_expanded(struct emsmdbp_table_categories *categories,
+					      struct emsmdbp_table_category *header)
+{
+	return header->depth < categories->expanded_count;
+}
+
+/**
+   \details Build the comparison key of a category column value
+
+   The first byte tells whether the row has the column at all, so rows
+   lacking it are grouped together. Strings are grouped regardless of
+   their case.
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_TOO_COMPLEX for types that
+   cannot be categorized, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_category_key(TALLOC_CTX *mem_ctx, enum MAPITAGS proptag,
+					    struct mapistore_property_data *data, DATA_BLOB *key)
+{
+	const uint8_t		*value;
+	size_t			length;
+	struct Binary_r		*bin;
+	uint8_t			*lowered = NULL;
+	size_t			i;
+
+	if (data->error != MAPISTORE_SUCCESS || !data->data) {
+		key->data = talloc_zero_array(mem_ctx, uint8_t, 1);
+		key->length = 1;
+		return key->data ? MAPI_E_SUCCESS : MAPI_E_NOT_ENOUGH_MEMORY;
+	}
+
+	value = data->data;
+	switch (proptag & 0xFFFF) {
+	case PT_I2:
+		length = sizeof (uint16_t);
+		break;
+	case PT_LONG:
+		length = sizeof (uint32_t);
+		break;
+	case PT_BOOLEAN:
+		length = sizeof (uint8_t);
+		break;
+	case PT_I8:
+		length = sizeof (uint64_t);
+		break;
+	case PT_SYSTIME:
+		length = sizeof (struct FILETIME);
+		break;
+	case PT_STRING8:
+	case PT_UNICODE:
+		length = strlen((const char *)data->data);
+		lowered = talloc_array(mem_ctx, uint8_t, length ? length : 1);
+		OPENCHANGE_RETVAL_IF(!lowered, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		for (i = 0; i < length; i++) {
+			lowered[i] = tolower(value[i]);
+		}
+		value = lowered;
+		break;
+	case PT_BINARY:
+		bin = (struct Binary_r *) data->data;
+		value = bin->lpb;
+		length = bin->cb;
+		break;
+	default:
+		OC_DEBUG(5, "Unsupported category column type: 0x%.8x\n", proptag);
+		return MAPI_E_TOO_COMPLEX;
+	}
+
+	key->data = talloc_array(mem_ctx, uint8_t, length + 1);
+	OPENCHANGE_RETVAL_IF(!key->data, MAPI_E_NOT_ENOUGH_MEMORY, lowered);
+	key->length = length + 1;
+	key->data[0] = 1;
+	if (length) {
+		memcpy(key->data + 1, value, length);
+	}
+	talloc_free(lowered);
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Copy a category column value so it outlives the backend row
+ */
+static void *emsmdbp_category_value_dup(TALLOC_CTX *mem_ctx, enum MAPITAGS proptag,
+					struct mapistore_property_data *data)
+{
+	struct Binary_r	*bin, *copy;
+
+	if (data->error != MAPISTORE_SUCCESS || !data->data) {
+		return NULL;
+	}
+
+	switch (proptag & 0xFFFF) {
+	case PT_I2:
+		return talloc_memdup(mem_ctx, data->data, sizeof (uint16_t));
+	case PT_LONG:
+		return talloc_memdup(mem_ctx, data->data, sizeof (uint32_t));
+	case PT_BOOLEAN:
+		return talloc_memdup(mem_ctx, data->data, sizeof (uint8_t));
+	case PT_I8:
+		return talloc_memdup(mem_ctx, data->data, sizeof (uint64_t));
+	case PT_SYSTIME:
+		return talloc_memdup(mem_ctx, data->data, sizeof (struct FILETIME));
+	case PT_STRING8:
+	case PT_UNICODE:
+		return talloc_strdup(mem_ctx, (const char *)data->data);
+	case PT_BINARY:
+		bin = (struct Binary_r *) data->data;
+		copy = talloc_zero(mem_ctx, struct Binary_r);
+		if (!copy) return NULL;
+		copy->cb = bin->cb;
+		copy->lpb = talloc_memdup(copy, bin->lpb, bin->cb ? bin->cb : 1);
+		return copy;
+	default:
+		return NULL;
+	}
+}
+
+/**
+   \details Derive the identifier of a category from its parent and
+   value, so that it is the same each time the view is built
+ */
+static uint64_t emsmdbp_category_id(uint64_t parent_id, uint16_t depth, DATA_BLOB *key)
+{
+	uint64_t	hash = 0xcbf29ce484222325ULL;
+	size_t		i;
+
+	for (i = 0; i < sizeof (uint64_t); i++) {
+		hash = (hash ^ ((parent_id >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+	}
+	hash = (hash ^ (depth & 0xff)) * 0x100000001b3ULL;
+	hash = (hash ^ (depth >> 8)) * 0x100000001b3ULL;
+	for (i = 0; i < key->length; i++) {
+		hash = (hash ^ key->data[i]) * 0x100000001b3ULL;
+	}
+
+	return hash ? hash : 1;
+}
+
+/**
+   \details Compute the visible position of every header and the
+   number of visible rows of the table
+ */
+static void emsmdbp_category_layout(struct emsmdbp_object_table *table)
+{
+	struct emsmdbp_table_categories	*categories = table->categories;
+	struct emsmdbp_table_category	*header, *parent;
+	uint32_t			position = 0;
+	uint32_t			i;
+
+	categories->visible_count = 0;
+	for (i = 0; i < categories->count; i++) {
+		header = &categories->headers[i];
+		parent = (header->parent == EMSMDBP_TABLE_CATEGORY_NONE) ? NULL : &categories->headers[header->parent];
+		if (parent && (parent->position == EMSMDBP_TABLE_CATEGORY_NONE || !parent->expanded)) {
+			header->position = EMSMDBP_TABLE_CATEGORY_NONE;
+			continue;
+		}
+		header->position = position++;
+		categories->visible[categories->visible_count++] = i;
+		if (header->expanded && header->depth == categories->level_count - 1) {
+			position += header->count;
+		}
+	}
+
+	table->denominator = position;
+}
+
+static int emsmdbp_category_state_cmp(const void *a, const void *b)
+{
+	const struct emsmdbp_category_state	*sa = a;
+	const struct emsmdbp_category_state	*sb = b;
+
+	return (sa->id < sb->id) ? -1 : (sa->id > sb->id);
+}
+
+/**
+   \details Append a header to the categories being built
+ */
+static struct emsmdbp_table_category *emsmdbp_category_add(struct emsmdbp_table_categories *categories,
+							   uint32_t *allocated)
+{
+	struct emsmdbp_table_category	*headers;
+
+	if (categories->count == *allocated) {
+		*allocated = *allocated ? *allocated * 2 : 16;
+		headers = talloc_realloc(categories, categories->headers, struct emsmdbp_table_category, *allocated);
+		if (!headers) return NULL;
+		categories->headers = headers;
+	}
+
+	memset(&categories->headers[categories->count], 0, sizeof (struct emsmdbp_table_category));
+	return &categories->headers[categories->count++];
+}
+
+/**
+   \details Scan the category columns of the backend table and build
+   the category headers
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param categories pointer to the categories to fill
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_category_scan(struct emsmdbp_context *emsmdbp_ctx,
+					     struct emsmdbp_object *table_object,
+					     struct emsmdbp_table_categories *categories)
+{
+	struct emsmdbp_object_table	*table = table_object->object.table;
+	struct emsmdbp_table_category	*header;
+	struct mapistore_property_data	**rows;
+	struct Binary_r			*conversation;
+	enum MAPITAGS			*columns;
+	enum mapistore_error		ret;
+	enum MAPISTATUS			retval = MAPI_E_SUCCESS;
+	TALLOC_CTX			*mem_ctx, *batch_ctx;
+	DATA_BLOB			*keys, key;
+	uint32_t			*open;
+	uint32_t			contextID, allocated = 0;
+	uint32_t			start, count, fetched, j;
+	uint16_t			level;
+	bool				changed;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	keys = talloc_zero_array(mem_ctx, DATA_BLOB, categories->level_count);
+	open = talloc_array(mem_ctx, uint32_t, categories->level_count);
+	columns = talloc_memdup(mem_ctx, categories->proptags, categories->level_count * sizeof (enum MAPITAGS));
+	OPENCHANGE_RETVAL_IF(!keys || !open || !columns, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+
+	/* Conversation identifiers are derived from the topic the backend knows */
+	for (level = 0; level < categories->level_count; level++) {
+		if (emsmdbp_conversation_column(columns[level])) {
+			columns[level] = PidTagConversationTopic;
+		}
+	}
+
+	contextID = emsmdbp_get_contextID(table_object);
+	ret = mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object,
+					  categories->level_count, columns);
+	OPENCHANGE_RETVAL_IF(ret != MAPISTORE_SUCCESS, mapistore_error_to_mapi(ret), mem_ctx);
+	mapistore_table_get_row_count(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object,
+				      MAPISTORE_PREFILTERED_QUERY, &categories->row_count);
+
+	for (start = 0; retval == MAPI_E_SUCCESS && start < categories->row_count; start += fetched) {
+		count = categories->row_count - start;
+		if (count > EMSMDBP_CATEGORY_SCAN_BATCH) {
+			count = EMSMDBP_CATEGORY_SCAN_BATCH;
+		}
+		batch_ctx = talloc_new(mem_ctx);
+		ret = mapistore_table_get_rows(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object, batch_ctx,
+					       MAPISTORE_PREFILTERED_QUERY, start, count, &rows, &fetched);
+		if (ret != MAPISTORE_SUCCESS) {
+			/* The remaining rows cannot be read: leave them out of the view */
+			OC_DEBUG(5, "  unable to read row %d: %s\n", start, mapistore_errstr(ret));
+			categories->row_count = start;
+			talloc_free(batch_ctx);
+			break;
+		}
+
+		for (j = 0; retval == MAPI_E_SUCCESS && j < fetched; j++) {
+			changed = false;
+			for (level = 0; level < categories->level_count; level++) {
+				if (columns[level] != categories->proptags[level]) {
+					conversation = talloc_zero(batch_ctx, struct Binary_r);
+					if (conversation) {
+						conversation->cb = MAPISTORE_CONVERSATION_ID_SIZE;
+						conversation->lpb = talloc_array(conversation, uint8_t, MAPISTORE_CONVERSATION_ID_SIZE);
+					}
+					if (!conversation || !conversation->lpb) {
+						retval = MAPI_E_NOT_ENOUGH_MEMORY;
+						break;
+					}
+					emsmdbp_conversation_id(rows[j][level].error == MAPISTORE_SUCCESS ? rows[j][level].data : NULL,
+								conversation->lpb);
+					rows[j][level].data = conversation;
+					rows[j][level].error = MAPISTORE_SUCCESS;
+				}
+				retval = emsmdbp_category_key(mem_ctx, categories->proptags[level], &rows[j][level], &key);
+				if (retval != MAPI_E_SUCCESS) break;
+
+				if (!changed && (start || j) && key.length == keys[level].length
+				    && memcmp(key.data, keys[level].data, key.length) == 0) {
+					categories->headers[open[level]].count++;
+					talloc_free(key.data);
+					continue;
+				}
+				changed = true;
+
+				header = emsmdbp_category_add(categories, &allocated);
+				if (!header) {
+					retval = MAPI_E_NOT_ENOUGH_MEMORY;
+					break;
+				}
+				header->depth = level;
+				header->parent = level ? open[level - 1] : EMSMDBP_TABLE_CATEGORY_NONE;
+				header->id = emsmdbp_category_id(level ? categories->headers[open[level - 1]].id : 0, level, &key);
+				header->value = emsmdbp_category_value_dup(categories, categories->proptags[level], &rows[j][level]);
+				header->start = start + j;
+				header->count = 1;
+				header->expanded = emsmdbp_category_default_expanded(categories, header);
+
+				talloc_free(keys[level].data);
+				keys[level] = key;
+				open[level] = categories->count - 1;
+			}
+		}
+		talloc_free(batch_ctx);
+	}
+
+	/* Restore the column set of the table */
+	if (table->prop_count) {
+		mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object,
+					    table->prop_count, table->properties);
+	}
+	talloc_free(mem_ctx);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	categories->visible = talloc_array(categories, uint32_t, categories->count ? categories->count : 1);
+	OPENCHANGE_RETVAL_IF(!categories->visible, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Rebuild the categories of a table, keeping the collapse
+   state of the categories that still exist
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param level_count the number of category columns
+   \param expanded_count the number of levels expanded by default
+   \param proptags the category columns
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_category_build(struct emsmdbp_context *emsmdbp_ctx,
+					      struct emsmdbp_object *table_object,
+					      uint16_t level_count, uint16_t expanded_count,
+					      const enum MAPITAGS *proptags)
+{
+	struct emsmdbp_object_table	*table = table_object->object.table;
+	struct emsmdbp_table_categories	*categories, *previous;
+	struct emsmdbp_category_state	*states = NULL, *state, needle;
+	enum MAPISTATUS			retval;
+	uint32_t			i;
+
+	categories = talloc_zero(table, struct emsmdbp_table_categories);
+	OPENCHANGE_RETVAL_IF(!categories, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	categories->generation = emsmdbp_ctx->table_generation;
+	categories->level_count = level_count;
+	categories->expanded_count = expanded_count;
+	categories->proptags = talloc_memdup(categories, proptags, sizeof (enum MAPITAGS) * level_count);
+	OPENCHANGE_RETVAL_IF(!categories->proptags, MAPI_E_NOT_ENOUGH_MEMORY, categories);
+
+	retval = emsmdbp_category_scan(emsmdbp_ctx, table_object, categories);
+	OPENCHANGE_RETVAL_IF(retval, retval, categories);
+
+	previous = table->categories;
+	if (previous && previous->count) {
+		states = talloc_array(categories, struct emsmdbp_category_state, previous->count);
+		OPENCHANGE_RETVAL_IF(!states, MAPI_E_NOT_ENOUGH_MEMORY, categories);
+		for (i = 0; i < previous->count; i++) {
+			states[i].id = previous->headers[i].id;
+			states[i].expanded = previous->headers[i].expanded;
+		}
+		qsort(states, previous->count, sizeof (struct emsmdbp_category_state), emsmdbp_category_state_cmp);
+
+		for (i = 0; i < categories->count; i++) {
+			needle.id = categories->headers[i].id;
+			state = bsearch(&needle, states, previous->count, sizeof (struct emsmdbp_category_state),
+					emsmdbp_category_state_cmp);
+			if (state) {
+				categories->headers[i].expanded = state->expanded;
+			}
+		}
+		talloc_free(states);
+	}
+
+	talloc_free(previous);
+	table->categories = categories;
+	emsmdbp_category_layout(table);
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Categorize a contents table according to its sort order
+
+   The backend must already be sorted on the sort order: its leading
+   cCategories columns are the category columns and the first
+   cExpanded levels are initially expanded.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param sort_order pointer to the sort order of the table
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_categorize(struct emsmdbp_context *emsmdbp_ctx,
+							 struct emsmdbp_object *table_object,
+							 struct SSortOrderSet *sort_order)
+{
+	enum MAPITAGS	*proptags;
+	enum MAPISTATUS	retval;
+	uint16_t	i;
+
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!table_object || table_object->type != EMSMDBP_OBJECT_TABLE, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!sort_order, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!sort_order->cCategories || sort_order->cCategories > sort_order->cSorts, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(sort_order->cExpanded > sort_order->cCategories, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!emsmdbp_is_mapistore(table_object), MAPI_E_NO_SUPPORT, NULL);
+
+	emsmdbp_object_table_categories_reset(table_object->object.table);
+
+	proptags = talloc_array(NULL, enum MAPITAGS, sort_order->cCategories);
+	OPENCHANGE_RETVAL_IF(!proptags, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	for (i = 0; i < sort_order->cCategories; i++) {
+		proptags[i] = sort_order->aSort[i].ulPropTag;
+	}
+
+	retval = emsmdbp_category_build(emsmdbp_ctx, table_object, sort_order->cCategories,
+					sort_order->cExpanded, proptags);
+	talloc_free(proptags);
+
+	return retval;
+}
+
+/**
+   \details Bring the categories of a table up to date
+
+   The headers are rebuilt when the contents of the tables may have
+   changed since they were computed, or when force is set. Categories
+   keep their collapse state across rebuilds.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param force whether the categories must be rebuilt
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_categories_refresh(struct emsmdbp_context *emsmdbp_ctx,
+								 struct emsmdbp_object *table_object,
+								 bool force)
+{
+	struct emsmdbp_table_categories	*categories;
+
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!table_object || table_object->type != EMSMDBP_OBJECT_TABLE, MAPI_E_INVALID_PARAMETER, NULL);
+
+	categories = table_object->object.table->categories;
+	if (!categories || (!force && categories->generation == emsmdbp_ctx->table_generation)) {
+		return MAPI_E_SUCCESS;
+	}
+
+	return emsmdbp_category_build(emsmdbp_ctx, table_object, categories->level_count,
+				      categories->expanded_count, categories->proptags);
+}
+
+/**
+   \details Drop the categories of a table, which becomes a flat table
+   again
+
+   \param table pointer to the table object
+ */
+_PUBLIC_ void emsmdbp_object_table_categories_reset(struct emsmdbp_object_table *table)
+{
+	if (!table || !table->categories) return;
+
+	table->denominator = table->categories->row_count;
+	talloc_free(table->categories);
+	table->categories = NULL;
+}
+
+/**
+   \details Retrieve the category header matching a category identifier
+
+   \param table pointer to the table object
+   \param id the category identifier
+
+   \return pointer to the header on success, otherwise NULL
+ */
+_PUBLIC_ struct emsmdbp_table_category *emsmdbp_object_table_category_find(struct emsmdbp_object_table *table, uint64_t id)
+{
+	uint32_t	i;
+
+	if (!table || !table->categories) return NULL;
+
+	for (i = 0; i < table->categories->count; i++) {
+		if (table->categories->headers[i].id == id) {
+			return &table->categories->headers[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+   \details Resolve a visible position of a categorized table
+
+   \param table pointer to the table object
+   \param position the visible position to resolve
+   \param headerp pointer to the header found at this position, or NULL
+   for leaf rows
+   \param row_idp pointer to the backend row of leaf rows
+
+   \return true if the position is valid, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_object_table_category_locate(struct emsmdbp_object_table *table, uint32_t position,
+						  struct emsmdbp_table_category **headerp, uint32_t *row_idp)
+{
+	struct emsmdbp_table_categories	*categories;
+	struct emsmdbp_table_category	*header;
+	uint32_t			low, high, middle, offset;
+
+	if (!table || !table->categories || !table->categories->visible_count) return false;
+	categories = table->categories;
+
+	/* Last visible header at or before position */
+	low = 0;
+	high = categories->visible_count;
+	while (high - low > 1) {
+		middle = low + (high - low) / 2;
+		if (categories->headers[categories->visible[middle]].position <= position) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+
+	header = &categories->headers[categories->visible[low]];
+	if (header->position > position) return false;
+	if (header->position == position) {
+		*headerp = header;
+		return true;
+	}
+
+	offset = position - header->position - 1;
+	if (!header->expanded || header->depth != categories->level_count - 1 || offset >= header->count) {
+		return false;
+	}
+	*headerp = NULL;
+	*row_idp = header->start + offset;
+
+	return true;
+}
+
+/**
+   \details Append the row at a visible position of a categorized table
+   to a row blob
+
+   Header rows carry the values of their category columns, along with
+   PidTagInstID, PidTagInstanceKey, PidTagRowType, PidTagDepth and
+   PidTagContentCount. Leaf rows are read from the backend.
+
+   \param mem_ctx pointer to the memory context of the row blob
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param position the visible position of the row
+   \param table_row pointer to the row blob to append to
+
+   \return true on success, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_object_table_category_fill_row(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+						    struct emsmdbp_object *table_object, uint32_t position,
+						    DATA_BLOB *table_row)
+{
+	struct emsmdbp_object_table	*table = table_object->object.table;
+	struct emsmdbp_table_category	*header, *ancestor;
+	struct Binary_r			instance_key;
+	enum MAPISTATUS			*retvals;
+	void				**data_pointers;
+	uint8_t				key[8];
+	uint32_t			row_type, depth, content_count, instance_num = 0;
+	uint32_t			row_id, i;
+	uint16_t			level;
+
+	if (!emsmdbp_object_table_category_locate(table, position, &header, &row_id)) {
+		return false;
+	}
+
+	if (!header) {
+		data_pointers = emsmdbp_object_table_get_row_props(mem_ctx, emsmdbp_ctx, table_object, row_id,
+								   MAPISTORE_PREFILTERED_QUERY, &retvals);
+		if (!data_pointers) return false;
+
+		row_type = TBL_LEAF_ROW;
+		depth = table->categories->level_count;
+		for (i = 0; i < table->prop_count; i++) {
+			if (table->properties[i] == PidTagRowType) {
+				data_pointers[i] = &row_type;
+				retvals[i] = MAPI_E_SUCCESS;
+			} else if (table->properties[i] == PidTagDepth) {
+				data_pointers[i] = &depth;
+				retvals[i] = MAPI_E_SUCCESS;
+			}
+		}
+		emsmdbp_fill_table_row_blob(mem_ctx, emsmdbp_ctx, table_row, table->prop_count,
+					    table->properties, data_pointers, retvals);
+		talloc_free(retvals);
+		talloc_free(data_pointers);
+		return true;
+	}
+
+	data_pointers = talloc_zero_array(mem_ctx, void *, table->prop_count);
+	retvals = talloc_array(mem_ctx, enum MAPISTATUS, table->prop_count);
+	if (!data_pointers || !retvals) {
+		talloc_free(data_pointers);
+		talloc_free(retvals);
+		return false;
+	}
+
+	row_type = (header->expanded) ? TBL_EXPANDED_CATEGORY : TBL_COLLAPSED_CATEGORY;
+	depth = header->depth;
+	content_count = header->count;
+	for (i = 0; i < sizeof (key); i++) {
+		key[i] = (header->id >> (i * 8)) & 0xff;
+	}
+	instance_key.cb = sizeof (key);
+	instance_key.lpb = key;
+
+	for (i = 0; i < table->prop_count; i++) {
+		retvals[i] = MAPI_E_SUCCESS;
+		switch (table->properties[i]) {
+		case PidTagInstID:
+			data_pointers[i] = &header->id;
+			continue;
+		case PidTagInstanceNum:
+			data_pointers[i] = &instance_num;
+			continue;
+		case PidTagInstanceKey:
+			data_pointers[i] = &instance_key;
+			continue;
+		case PidTagRowType:
+			data_pointers[i] = &row_type;
+			continue;
+		case PidTagDepth:
+			data_pointers[i] = &depth;
+			continue;
+		case PidTagContentCount:
+			data_pointers[i] = &content_count;
+			continue;
+		default:
+			break;
+		}
+
+		/* Values of this category and of its ancestors */
+		retvals[i] = MAPI_E_NOT_FOUND;
+		for (level = 0; level <= header->depth; level++) {
+			if (table->properties[i] != table->categories->proptags[level]) continue;
+			for (ancestor = header; ancestor->depth != level; ancestor = &table->categories->headers[ancestor->parent]);
+			if (ancestor->value) {
+				data_pointers[i] = ancestor->value;
+				retvals[i] = MAPI_E_SUCCESS;
+			}
+			break;
+		}
+	}
+
+	emsmdbp_fill_table_row_blob(mem_ctx, emsmdbp_ctx, table_row, table->prop_count,
+				    table->properties, data_pointers, retvals);
+	talloc_free(retvals);
+	talloc_free(data_pointers);
+
+	return true;
+}
+
+/**
+   \details Expand or collapse a category
+
+   The cursor keeps pointing at the same row, or at the row following
+   the category when the row it pointed at gets hidden.
+
+   \param table pointer to the table object
+   \param header pointer to the category header
+   \param expanded whether the category is to be expanded or collapsed
+   \param countp pointer to the number of rows shown or hidden
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_category_set_expanded(struct emsmdbp_object_table *table,
+								    struct emsmdbp_table_category *header,
+								    bool expanded, uint32_t *countp)
+{
+	uint32_t	before, delta;
+
+	OPENCHANGE_RETVAL_IF(!table || !table->categories || !header, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!countp, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(expanded && header->expanded, ecNotCollapsed, NULL);
+	OPENCHANGE_RETVAL_IF(!expanded && !header->expanded, ecNotExpanded, NULL);
+
+	before = table->denominator;
+	header->expanded = expanded;
+	emsmdbp_category_layout(table);
+
+	*countp = 0;
+	if (header->position == EMSMDBP_TABLE_CATEGORY_NONE) {
+		return MAPI_E_SUCCESS;
+	}
+
+	if (expanded) {
+		delta = table->denominator - before;
+		if (table->numerator > header->position) {
+			table->numerator += delta;
+		}
+	} else {
+		delta = before - table->denominator;
+		if (table->numerator > header->position + delta) {
+			table->numerator -= delta;
+		} else if (table->numerator > header->position) {
+			table->numerator = header->position + 1;
+		}
+	}
+	*countp = delta;
+
+	return MAPI_E_SUCCESS;
+}
+
+static void emsmdbp_category_push_uint(uint8_t *data, uint64_t value, size_t length)
+{
+	size_t	i;
+
+	for (i = 0; i < length; i++) {
+		data[i] = (value >> (i * 8)) & 0xff;
+	}
+}
+
+static uint64_t emsmdbp_category_pull_uint(const uint8_t *data, size_t length)
+{
+	uint64_t	value = 0;
+	size_t		i;
+
+	for (i = 0; i < length; i++) {
+		value |= (uint64_t)data[i] << (i * 8);
+	}
+
+	return value;
+}
+
+/**
+   \details Serialize the collapse state of a categorized table
+
+   The state holds the cursor and the identifiers of the categories
+   whose state differs from the default of their level. Category
+   identifiers only depend on the category values, so the state can be
+   restored on another table object with the same sort order.
+
+   \param mem_ctx pointer to the memory context
+   \param table pointer to the table object
+   \param row_id the PidTagInstID of the row to use as the cursor
+   \param state pointer to the serialized state to fill
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_categories_get_state(TALLOC_CTX *mem_ctx,
+								   struct emsmdbp_object_table *table,
+								   uint64_t row_id,
+								   struct SBinary_short *state)
+{
+	struct emsmdbp_table_categories	*categories;
+	struct emsmdbp_table_category	*header;
+	uint32_t			count = 0, i;
+	size_t				length;
+
+	OPENCHANGE_RETVAL_IF(!table || !table->categories, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!state, MAPI_E_INVALID_PARAMETER, NULL);
+	categories = table->categories;
+
+	for (i = 0; i < categories->count; i++) {
+		if (categories->headers[i].expanded != emsmdbp_category_default_expanded(categories, &categories->headers[i])) {
+			count++;
+		}
+	}
+
+	length = EMSMDBP_CATEGORY_STATE_HEADER + count * sizeof (uint64_t);
+	OPENCHANGE_RETVAL_IF(length > 0xFFFF, MAPI_E_TOO_BIG, NULL);
+	state->lpb = talloc_array(mem_ctx, uint8_t, length);
+	OPENCHANGE_RETVAL_IF(!state->lpb, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	state->cb = length;
+
+	header = emsmdbp_object_table_category_find(table, row_id);
+	emsmdbp_category_push_uint(state->lpb, header ? row_id : 0, 8);
+	emsmdbp_category_push_uint(state->lpb + 8, table->numerator, 4);
+	emsmdbp_category_push_uint(state->lpb + 12, count, 4);
+	for (i = 0, length = EMSMDBP_CATEGORY_STATE_HEADER; i < categories->count; i++) {
+		if (categories->headers[i].expanded != emsmdbp_category_default_expanded(categories, &categories->headers[i])) {
+			emsmdbp_category_push_uint(state->lpb + length, categories->headers[i].id, 8);
+			length += sizeof (uint64_t);
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Restore a collapse state returned by
+   emsmdbp_object_table_categories_get_state
+
+   Categories that no longer exist are ignored.
+
+   \param table pointer to the table object
+   \param state pointer to the serialized state
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_categories_set_state(struct emsmdbp_object_table *table,
+								   const struct SBinary_short *state)
+{
+	struct emsmdbp_table_categories	*categories;
+	struct emsmdbp_table_category	*header;
+	uint64_t			cursor_id;
+	uint32_t			position, count, i;
+
+	OPENCHANGE_RETVAL_IF(!table || !table->categories, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!state || state->cb < EMSMDBP_CATEGORY_STATE_HEADER || !state->lpb, MAPI_E_INVALID_PARAMETER, NULL);
+	categories = table->categories;
+
+	cursor_id = emsmdbp_category_pull_uint(state->lpb, 8);
+	position = emsmdbp_category_pull_uint(state->lpb + 8, 4);
+	count = emsmdbp_category_pull_uint(state->lpb + 12, 4);
+	OPENCHANGE_RETVAL_IF(state->cb != EMSMDBP_CATEGORY_STATE_HEADER + (size_t)count * sizeof (uint64_t),
+			     MAPI_E_INVALID_PARAMETER, NULL);
+
+	for (i = 0; i < categories->count; i++) {
+		categories->headers[i].expanded = emsmdbp_category_default_expanded(categories, &categories->headers[i]);
+	}
+	for (i = 0; i < count; i++) {
+		header = emsmdbp_object_table_category_find(table, emsmdbp_category_pull_uint(state->lpb + EMSMDBP_CATEGORY_STATE_HEADER + i * sizeof (uint64_t), 8));
+		if (header) {
+			header->expanded = !emsmdbp_category_default_expanded(categories, header);
+		}
+	}
+	emsmdbp_category_layout(table);
+
+	header = cursor_id ? emsmdbp_object_table_category_find(table, cursor_id) : NULL;
+	if (header && header->position != EMSMDBP_TABLE_CATEGORY_NONE) {
+		table->numerator = header->position;
+	} else {
+		table->numerator = (position < table->denominator) ? position : table->denominator;
+	}
+
+	return MAPI_E_SUCCESS;
+}
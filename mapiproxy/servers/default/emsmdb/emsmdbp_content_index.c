@@ -0,0 +1,292 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_content_index.c
+
+   \brief Content index maintenance
+
+   When mapistore:content_index is set, the text properties of the
+   messages of a folder are indexed the first time a content restriction
+   is evaluated on the folder, then kept up to date with the messages
+   saved, deleted and moved through emsmdbp. Messages changed directly
+   in the backend are not seen until the folder index is dropped.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+
+/**
+   \details Index the text properties of a message from the values read
+   from the message or one of its table rows
+ */
+static void emsmdbp_content_index_add(struct emsmdbp_context *emsmdbp_ctx, const char *owner, uint64_t fid, uint64_t mid,
+				      const struct SPropTagArray *proptags, void **data_pointers, enum MAPISTATUS *retvals)
+{
+	TALLOC_CTX		*mem_ctx;
+	const char		**texts;
+	bool			partial = false;
+	uint32_t		i;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	texts = talloc_zero_array(mem_ctx, const char *, proptags->cValues);
+	if (!texts) goto end;
+
+	for (i = 0; i < proptags->cValues; i++) {
+		if (retvals[i] == MAPI_E_SUCCESS) {
+			texts[i] = (const char *) data_pointers[i];
+		} else if (retvals[i] != MAPI_E_NOT_FOUND) {
+			partial = true;
+		}
+	}
+
+	if (mapistore_content_index_add(emsmdbp_ctx->mstore_ctx, owner, fid, mid, proptags->cValues,
+					proptags->aulPropTag, texts, partial) != MAPISTORE_SUCCESS) {
+		mapistore_content_index_folder_invalidate(emsmdbp_ctx->mstore_ctx, owner, fid);
+	}
+
+end:
+	talloc_free(mem_ctx);
+}
+
+
+/**
+   \details Index every message of a folder
+ */
+static enum MAPISTATUS emsmdbp_content_index_build(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum mapistore_error		ret;
+	struct emsmdbp_object		*table_object;
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_table_row_props	*rows;
+	struct SPropTagArray		*proptags;
+	struct SPropTagArray		text_proptags;
+	char				*owner;
+	uint64_t			fid;
+	uint32_t			i, start, count, fetched, denominator;
+
+	owner = emsmdbp_get_owner(folder);
+	fid = folder->object.folder->folderID;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	ret = mapistore_content_index_get_proptags(mem_ctx, &proptags);
+	OPENCHANGE_RETVAL_IF(ret, mapistore_error_to_mapi(ret), mem_ctx);
+
+	ret = mapistore_content_index_folder_reset(emsmdbp_ctx->mstore_ctx, owner, fid);
+	OPENCHANGE_RETVAL_IF(ret, mapistore_error_to_mapi(ret), mem_ctx);
+
+	table_object = emsmdbp_folder_open_table(mem_ctx, folder, MAPISTORE_MESSAGE_TABLE, 0);
+	if (!table_object) {
+		mapistore_content_index_folder_invalidate(emsmdbp_ctx->mstore_ctx, owner, fid);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_INVALID_OBJECT, mem_ctx);
+	}
+
+	/* PidTagMid followed by the text properties */
+	table = table_object->object.table;
+	table->prop_count = proptags->cValues + 1;
+	table->properties = talloc_array(table, enum MAPITAGS, table->prop_count);
+	if (!table->properties) {
+		mapistore_content_index_folder_invalidate(emsmdbp_ctx->mstore_ctx, owner, fid);
+		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	}
+	table->properties[0] = PidTagMid;
+	memcpy(table->properties + 1, proptags->aulPropTag, proptags->cValues * sizeof (enum MAPITAGS));
+	if (emsmdbp_is_mapistore(table_object)) {
+		mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(table_object),
+					    table_object->backend_object, table->prop_count, table->properties);
+	}
+	text_proptags.cValues = proptags->cValues;
+	text_proptags.aulPropTag = table->properties + 1;
+	denominator = table->denominator;
+
+	for (start = 0; start < denominator; start += fetched) {
+		count = denominator - start;
+		if (count > EMSMDBP_TABLE_ROW_CACHE_SIZE) {
+			count = EMSMDBP_TABLE_ROW_CACHE_SIZE;
+		}
+		rows = emsmdbp_object_table_get_rows_props(mem_ctx, emsmdbp_ctx, table_object, start, count,
+							   MAPISTORE_PREFILTERED_QUERY, &fetched);
+		for (i = 0; i < fetched; i++) {
+			if (rows[i].retvals[0] != MAPI_E_SUCCESS) continue;
+			emsmdbp_content_index_add(emsmdbp_ctx, owner, fid, *(uint64_t *)rows[i].data_pointers[0],
+						  &text_proptags, rows[i].data_pointers + 1, rows[i].retvals + 1);
+		}
+		talloc_free(rows);
+		if (!fetched) fetched = 1;
+	}
+	talloc_free(mem_ctx);
+
+	OC_DEBUG(5, "content index of folder 0x%"PRIx64" built from %d rows", fid, denominator);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the messages of a folder which may match a
+   restriction, from the content index of the folder
+
+   The index of the folder is built the first time it is needed. The
+   returned messages are a superset of the matching ones: the caller
+   evaluates the restriction on each of them.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder pointer to the folder object
+   \param res pointer to the restriction
+   \param midsp pointer to the returned array of message identifiers
+   \param countp pointer to the returned number of messages
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT if the index is
+   disabled or does not help with this restriction, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_content_index_candidates(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+							  struct emsmdbp_object *folder, const struct mapi_SRestriction *res,
+							  uint64_t **midsp, uint32_t *countp)
+{
+	enum mapistore_error	ret;
+	enum MAPISTATUS		retval;
+	char			*owner;
+	uint64_t		fid;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!folder || folder->type != EMSMDBP_OBJECT_FOLDER, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!res || !midsp || !countp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	owner = emsmdbp_get_owner(folder);
+	OPENCHANGE_RETVAL_IF(!owner, MAPI_E_NO_SUPPORT, NULL);
+	fid = folder->object.folder->folderID;
+
+	ret = mapistore_content_index_query(mem_ctx, emsmdbp_ctx->mstore_ctx, owner, fid, res, midsp, countp);
+	if (ret == MAPISTORE_ERR_NOT_FOUND) {
+		retval = emsmdbp_content_index_build(emsmdbp_ctx, folder);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		ret = mapistore_content_index_query(mem_ctx, emsmdbp_ctx->mstore_ctx, owner, fid, res, midsp, countp);
+	}
+	OPENCHANGE_RETVAL_IF(ret == MAPISTORE_ERR_NOT_AVAILABLE, MAPI_E_NO_SUPPORT, NULL);
+	OPENCHANGE_RETVAL_IF(ret, mapistore_error_to_mapi(ret), NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Index a message saved by the session, when its folder is
+   indexed
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object pointer to the saved message object
+ */
+_PUBLIC_ void emsmdbp_content_index_message_saved(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *message_object)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct emsmdbp_object	*folder_object;
+	struct SPropTagArray	*proptags;
+	void			**data_pointers;
+	enum MAPISTATUS		*retvals = NULL;
+	char			*owner;
+	uint64_t		fid;
+
+	if (!emsmdbp_ctx || !message_object || message_object->type != EMSMDBP_OBJECT_MESSAGE) return;
+	folder_object = message_object->parent_object;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	owner = emsmdbp_get_owner(folder_object);
+	fid = folder_object->object.folder->folderID;
+	if (!mapistore_content_index_folder_exists(emsmdbp_ctx->mstore_ctx, owner, fid)) return;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	if (mapistore_content_index_get_proptags(mem_ctx, &proptags) != MAPISTORE_SUCCESS) {
+		mapistore_content_index_folder_invalidate(emsmdbp_ctx->mstore_ctx, owner, fid);
+		goto end;
+	}
+
+	data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, message_object, proptags, &retvals);
+	if (data_pointers) {
+		emsmdbp_content_index_add(emsmdbp_ctx, owner, fid, message_object->object.message->messageID,
+					  proptags, data_pointers, retvals);
+	} else {
+		mapistore_content_index_add(emsmdbp_ctx->mstore_ctx, owner, fid, message_object->object.message->messageID,
+					    0, NULL, NULL, true);
+	}
+
+end:
+	talloc_free(mem_ctx);
+}
+
+
+/**
+   \details Record a message copied or moved into a folder without
+   reading it: it is returned as a candidate of every query on the
+   folder until it is saved again or the index is rebuilt
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the folder receiving the message
+   \param mid the message identifier
+ */
+_PUBLIC_ void emsmdbp_content_index_message_changed(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object, uint64_t mid)
+{
+	char		*owner;
+	uint64_t	fid;
+
+	if (!emsmdbp_ctx || !folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	owner = emsmdbp_get_owner(folder_object);
+	fid = folder_object->object.folder->folderID;
+	if (mapistore_content_index_add(emsmdbp_ctx->mstore_ctx, owner, fid, mid, 0, NULL, NULL, true) != MAPISTORE_SUCCESS) {
+		mapistore_content_index_folder_invalidate(emsmdbp_ctx->mstore_ctx, owner, fid);
+	}
+}
+
+
+/**
+   \details Remove deleted or moved out messages from the index of their
+   folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the folder the messages were in
+   \param count number of message identifiers
+   \param mids array of message identifiers
+ */
+_PUBLIC_ void emsmdbp_content_index_messages_deleted(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object,
+						     uint32_t count, const uint64_t *mids)
+{
+	char		*owner;
+	uint64_t	fid;
+
+	if (!emsmdbp_ctx || !count || !mids) return;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	owner = emsmdbp_get_owner(folder_object);
+	fid = folder_object->object.folder->folderID;
+	if (mapistore_content_index_del(emsmdbp_ctx->mstore_ctx, owner, fid, count, mids) != MAPISTORE_SUCCESS) {
+		mapistore_content_index_folder_invalidate(emsmdbp_ctx->mstore_ctx, owner, fid);
+	}
+}
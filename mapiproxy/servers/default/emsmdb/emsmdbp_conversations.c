@@ -0,0 +1,194 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_conversations.c
+
+   \brief Conversation index maintenance
+
+   When mapistore:conversations is set, the messages saved, deleted,
+   copied and moved through emsmdbp are kept in the conversation index
+   of the mailbox (see mapistore_conversations.c).
+
+   Backends seldom know PidTagConversationId: emsmdbp derives it from
+   the conversation topic, regardless of its case, so messages with the
+   same topic share a conversation in every folder. Contents tables
+   categorized on PidTagConversationId are sorted on the topic by the
+   backend and grouped on the derived identifier (see
+   emsmdbp_category.c), without reading any other column.
+ */
+
+#include <ctype.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
+#include "libmapi/property_tags.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+
+/**
+   \details Compute the conversation identifier of a topic
+
+   \param topic the conversation topic, NULL or empty for messages
+   without topic
+   \param id pointer to the returned identifier,
+   MAPISTORE_CONVERSATION_ID_SIZE bytes
+ */
+_PUBLIC_ void emsmdbp_conversation_id(const char *topic, uint8_t *id)
+{
+	char		*lowered;
+	uint64_t	high = 0, low = 0;
+	size_t		i, length;
+
+	lowered = topic ? talloc_strdup(NULL, topic) : NULL;
+	if (lowered) {
+		length = strlen(lowered);
+		for (i = 0; i < length; i++) {
+			lowered[i] = tolower((unsigned char) lowered[i]);
+		}
+		high = hash64_stable(lowered, length, 0);
+		low = hash64_stable(lowered, length, 1);
+		talloc_free(lowered);
+	}
+
+	for (i = 0; i < 8; i++) {
+		id[i] = (high >> (56 - 8 * i)) & 0xff;
+		id[8 + i] = (low >> (56 - 8 * i)) & 0xff;
+	}
+}
+
+
+/**
+   \details Tell whether a category column is the conversation
+   identifier emsmdbp derives from the topic
+ */
+_PUBLIC_ bool emsmdbp_conversation_column(enum MAPITAGS proptag)
+{
+	return mapistore_conversations_enabled() && proptag == PidTagConversationId;
+}
+
+
+/**
+   \details Index a message saved by the session in its conversation
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object pointer to the saved message object
+ */
+_PUBLIC_ void emsmdbp_conversations_message_saved(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *message_object)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct emsmdbp_object	*folder_object;
+	struct SPropTagArray	*proptags;
+	void			**data_pointers;
+	enum MAPISTATUS		*retvals = NULL;
+	const char		*topic = NULL;
+	struct FILETIME		*ft = NULL;
+	uint8_t			id[MAPISTORE_CONVERSATION_ID_SIZE];
+	NTTIME			delivery;
+	char			*owner;
+
+	if (!mapistore_conversations_enabled()) return;
+	if (!emsmdbp_ctx || !message_object || message_object->type != EMSMDBP_OBJECT_MESSAGE) return;
+	folder_object = message_object->parent_object;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	proptags = set_SPropTagArray(mem_ctx, 4, PidTagConversationTopic, PidTagNormalizedSubject,
+				     PidTagMessageDeliveryTime, PidTagLastModificationTime);
+	data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, message_object, proptags, &retvals);
+	if (data_pointers) {
+		topic = (retvals[0] == MAPI_E_SUCCESS) ? data_pointers[0] : NULL;
+		if (!topic && retvals[1] == MAPI_E_SUCCESS) {
+			topic = data_pointers[1];
+		}
+		ft = (retvals[2] == MAPI_E_SUCCESS) ? data_pointers[2] : NULL;
+		if (!ft && retvals[3] == MAPI_E_SUCCESS) {
+			ft = data_pointers[3];
+		}
+	}
+
+	if (ft) {
+		delivery = ((NTTIME) ft->dwHighDateTime << 32) | ft->dwLowDateTime;
+	} else {
+		unix_to_nt_time(&delivery, time(NULL));
+	}
+	emsmdbp_conversation_id(topic, id);
+
+	owner = emsmdbp_get_owner(folder_object);
+	if (mapistore_conversations_add(emsmdbp_ctx->mstore_ctx, owner, id, folder_object->object.folder->folderID,
+					message_object->object.message->messageID, delivery) != MAPISTORE_SUCCESS) {
+		OC_DEBUG(3, "unable to index message 0x%.16"PRIx64" in its conversation\n",
+			 message_object->object.message->messageID);
+	}
+
+	talloc_free(mem_ctx);
+}
+
+
+/**
+   \details Index copied or moved messages in the conversations of the
+   source messages
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the folder receiving the messages
+   \param count number of messages
+   \param source_mids the identifiers of the source messages
+   \param target_mids the identifiers of the new messages
+   \param move whether the source messages are gone
+ */
+_PUBLIC_ void emsmdbp_conversations_messages_copied(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object,
+						    uint32_t count, const uint64_t *source_mids, const uint64_t *target_mids,
+						    bool move)
+{
+	if (!mapistore_conversations_enabled()) return;
+	if (!emsmdbp_ctx || !count || !source_mids || !target_mids) return;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	if (mapistore_conversations_copy(emsmdbp_ctx->mstore_ctx, emsmdbp_get_owner(folder_object),
+					 folder_object->object.folder->folderID, count,
+					 source_mids, target_mids, move) != MAPISTORE_SUCCESS) {
+		OC_DEBUG(3, "unable to index %"PRIu32" messages in their conversations\n", count);
+	}
+}
+
+
+/**
+   \details Remove deleted messages from their conversations
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the folder the messages were in
+   \param count number of message identifiers
+   \param mids array of message identifiers
+ */
+_PUBLIC_ void emsmdbp_conversations_messages_deleted(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object,
+						     uint32_t count, const uint64_t *mids)
+{
+	if (!mapistore_conversations_enabled()) return;
+	if (!emsmdbp_ctx || !count || !mids) return;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	if (mapistore_conversations_del(emsmdbp_ctx->mstore_ctx, emsmdbp_get_owner(folder_object),
+					count, mids) != MAPISTORE_SUCCESS) {
+		OC_DEBUG(3, "unable to remove %"PRIu32" messages from their conversations\n", count);
+	}
+}
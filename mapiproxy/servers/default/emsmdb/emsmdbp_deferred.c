@@ -0,0 +1,206 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_deferred.c
+
+   \brief Deferred indexing cleanup of deleted folders
+
+   Deleting a large folder tree leaves one indexing record per deleted
+   folder and message to remove. When emsmdb:deferred_delete_batch is
+   set, the record of the deleted folder is removed at once, which
+   tombstones it, while the records of its content are queued on the
+   session and removed in batches from a timer of the server event
+   loop, between requests. Whatever is still queued when the session
+   ends is removed before the mapistore context is released.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Delay between two batches, in microseconds */
+#define	EMSMDBP_DEFERRED_DELETE_DELAY	10000
+
+struct emsmdbp_deferred_delete {
+	struct emsmdbp_deferred_delete	*prev;
+	struct emsmdbp_deferred_delete	*next;
+	uint32_t			context_id;
+	char				*owner;
+	uint64_t			*fmids;
+	uint32_t			count;
+	uint32_t			offset;
+	uint8_t				flags;
+};
+
+static void emsmdbp_deferred_delete_handler(struct tevent_context *, struct tevent_timer *, struct timeval, void *);
+
+
+/**
+   \details Remove the next batch of records of the first queued
+   deletion
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param batch the maximum number of records to remove
+
+   \return true if records remain queued, otherwise false
+ */
+static bool emsmdbp_deferred_delete_step(struct emsmdbp_context *emsmdbp_ctx, uint32_t batch)
+{
+	struct emsmdbp_deferred_delete	*entry = emsmdbp_ctx->deferred_deletes;
+	enum mapistore_error		ret;
+	uint32_t			len;
+
+	if (!entry) return false;
+
+	len = entry->count - entry->offset;
+	if (batch && len > batch) len = batch;
+
+	ret = mapistore_indexing_record_del_fmids(emsmdbp_ctx->mstore_ctx, entry->context_id, entry->owner,
+						  len, entry->fmids + entry->offset, entry->flags);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(3, "unable to remove %"PRIu32" indexing records of %s: %s\n", len, entry->owner,
+			 mapistore_errstr(ret));
+	}
+	entry->offset += len;
+
+	if (entry->offset == entry->count) {
+		DLIST_REMOVE(emsmdbp_ctx->deferred_deletes, entry);
+		mapistore_del_context(emsmdbp_ctx->mstore_ctx, entry->context_id);
+		talloc_free(entry);
+	}
+
+	return (emsmdbp_ctx->deferred_deletes != NULL);
+}
+
+
+/**
+   \details Arm the timer of the next batch
+ */
+static void emsmdbp_deferred_delete_schedule(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (emsmdbp_ctx->deferred_timer) return;
+
+	emsmdbp_ctx->deferred_timer = tevent_add_timer(emsmdbp_ctx->ev_ctx, emsmdbp_ctx,
+						       tevent_timeval_current_ofs(0, EMSMDBP_DEFERRED_DELETE_DELAY),
+						       emsmdbp_deferred_delete_handler, emsmdbp_ctx);
+	if (!emsmdbp_ctx->deferred_timer) {
+		OC_DEBUG(1, "unable to schedule deferred indexing cleanup, removing records now\n");
+		emsmdbp_deferred_delete_flush(emsmdbp_ctx);
+	}
+}
+
+
+static void emsmdbp_deferred_delete_handler(struct tevent_context *ev, struct tevent_timer *te,
+					    struct timeval current_time, void *private_data)
+{
+	struct emsmdbp_context	*emsmdbp_ctx = talloc_get_type_abort(private_data, struct emsmdbp_context);
+	int			batch;
+
+	/* the timer is freed by tevent once it fired */
+	emsmdbp_ctx->deferred_timer = NULL;
+
+	batch = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "deferred_delete_batch", 0);
+	if (emsmdbp_deferred_delete_step(emsmdbp_ctx, batch > 0 ? batch : 0)) {
+		emsmdbp_deferred_delete_schedule(emsmdbp_ctx);
+	}
+}
+
+
+/**
+   \details Remove the indexing records of a deleted folder and of its
+   content, deferring the content when it is larger than
+   emsmdb:deferred_delete_batch
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param context_id the context identifier
+   \param username the owner of the folder
+   \param fid the folder identifier
+   \param deleted_fmids the array of child fmids from the folder
+   \param deleted_fmids_count the number of deleted_fmids
+   \param flags the delete flags. See emsmdbp_folder_delete for details.
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error.
+ */
+_PUBLIC_ enum mapistore_error emsmdbp_deferred_delete_indexing_records(struct emsmdbp_context *emsmdbp_ctx, uint32_t context_id,
+								       char *username, uint64_t fid,
+								       uint64_t *deleted_fmids, uint32_t deleted_fmids_count,
+								       uint8_t flags)
+{
+	struct emsmdbp_deferred_delete	*entry;
+	enum mapistore_error		ret;
+	int				batch;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!emsmdbp_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!username, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	batch = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "deferred_delete_batch", 0);
+	/* The timer can't be driven from the worker threads: the call
+	 * doesn't block the event loop there anyway */
+	if (batch <= 0 || !emsmdbp_ctx->ev_ctx || emsmdbp_threads_enabled() ||
+	    deleted_fmids_count <= (uint32_t) batch) {
+		return emsmdbp_folder_delete_indexing_records(emsmdbp_ctx->mstore_ctx, context_id, username, fid,
+							      deleted_fmids, deleted_fmids_count, flags);
+	}
+
+	entry = talloc_zero(emsmdbp_ctx, struct emsmdbp_deferred_delete);
+	MAPISTORE_RETVAL_IF(!entry, MAPISTORE_ERR_NO_MEMORY, NULL);
+	entry->owner = talloc_strdup(entry, username);
+	MAPISTORE_RETVAL_IF(!entry->owner, MAPISTORE_ERR_NO_MEMORY, entry);
+	entry->fmids = talloc_memdup(entry, deleted_fmids, deleted_fmids_count * sizeof (uint64_t));
+	MAPISTORE_RETVAL_IF(!entry->fmids, MAPISTORE_ERR_NO_MEMORY, entry);
+	entry->count = deleted_fmids_count;
+	entry->context_id = context_id;
+	entry->flags = (flags & DELETE_HARD_DELETE) ? MAPISTORE_PERMANENT_DELETE : MAPISTORE_SOFT_DELETE;
+
+	/* The folder itself is tombstoned right away */
+	ret = mapistore_indexing_record_del_fid(emsmdbp_ctx->mstore_ctx, context_id, username, fid, entry->flags);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, entry);
+
+	/* The context must outlive the queued records */
+	ret = mapistore_add_context_ref_count(emsmdbp_ctx->mstore_ctx, context_id);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, entry);
+
+	DLIST_ADD_END(emsmdbp_ctx->deferred_deletes, entry, struct emsmdbp_deferred_delete *);
+	OC_DEBUG(5, "indexing cleanup of %"PRIu32" records of folder 0x%"PRIx64" deferred\n", deleted_fmids_count, fid);
+
+	emsmdbp_deferred_delete_schedule(emsmdbp_ctx);
+
+	return MAPISTORE_SUCCESS;
+}
+
+
+/**
+   \details Remove all the queued indexing records now
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_deferred_delete_flush(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx) return;
+
+	if (emsmdbp_ctx->deferred_timer) {
+		talloc_free(emsmdbp_ctx->deferred_timer);
+		emsmdbp_ctx->deferred_timer = NULL;
+	}
+
+	while (emsmdbp_deferred_delete_step(emsmdbp_ctx, 0));
+}
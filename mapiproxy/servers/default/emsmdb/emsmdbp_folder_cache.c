@@ -0,0 +1,268 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_folder_cache.c
+
+   \brief Folders opened in a session
+
+   Opening a folder by its identifier opens all its ancestors first,
+   and each of them requires the parent identifier to be looked up in
+   openchangedb or the indexing database. Clients reopen the same
+   folders all the time, so the session remembers the parent of the
+   folders it resolved, and the folder objects still open for each of
+   them.
+
+   The cache does not keep folder objects alive: an object is only
+   reused as the parent of another folder while a handle or a child
+   object holds it, and it leaves the cache when it is freed. Parents
+   are forgotten when a folder is moved or deleted, by this session or
+   by another one as far as this session is notified of it.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Number of folders whose parent is kept on a session */
+#define	EMSMDBP_FOLDER_CACHE_SIZE	256
+
+static int emsmdbp_folder_cache_destructor(struct emsmdbp_folder_cache *entry)
+{
+	if (entry->object) {
+		entry->object->object.folder->cache_entry = NULL;
+	}
+
+	return 0;
+}
+
+static struct emsmdbp_folder_cache *emsmdbp_folder_cache_find(struct emsmdbp_context *emsmdbp_ctx,
+							      const char *owner, uint64_t fid)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	for (entry = emsmdbp_ctx->folder_cache; entry; entry = entry->next) {
+		if (entry->fid == fid && !strcmp(entry->owner, owner)) {
+			/* most recently used first */
+			if (entry != emsmdbp_ctx->folder_cache) {
+				DLIST_REMOVE(emsmdbp_ctx->folder_cache, entry);
+				DLIST_ADD(emsmdbp_ctx->folder_cache, entry);
+			}
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Retrieve the parent of a folder resolved earlier in this
+   session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox the folder belongs to
+   \param fid the folder identifier
+   \param parent_fidp pointer to the parent folder identifier to return
+
+   \return true if the parent is known, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_folder_cache_get_parent(struct emsmdbp_context *emsmdbp_ctx, const char *owner,
+					      uint64_t fid, uint64_t *parent_fidp)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner || !parent_fidp) return false;
+
+	entry = emsmdbp_folder_cache_find(emsmdbp_ctx, owner, fid);
+	if (!entry || !entry->parent_known) return false;
+
+	*parent_fidp = entry->parent_fid;
+
+	return true;
+}
+
+
+static struct emsmdbp_folder_cache *emsmdbp_folder_cache_add(struct emsmdbp_context *emsmdbp_ctx,
+							     const char *owner, uint64_t fid)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	entry = emsmdbp_folder_cache_find(emsmdbp_ctx, owner, fid);
+	if (entry) return entry;
+
+	entry = talloc_zero(emsmdbp_ctx, struct emsmdbp_folder_cache);
+	if (!entry) return NULL;
+	entry->owner = talloc_strdup(entry, owner);
+	if (!entry->owner) {
+		talloc_free(entry);
+		return NULL;
+	}
+	entry->fid = fid;
+	talloc_set_destructor(entry, emsmdbp_folder_cache_destructor);
+
+	if (emsmdbp_ctx->folder_cache_count >= EMSMDBP_FOLDER_CACHE_SIZE) {
+		struct emsmdbp_folder_cache	*last;
+
+		last = DLIST_TAIL(emsmdbp_ctx->folder_cache);
+		DLIST_REMOVE(emsmdbp_ctx->folder_cache, last);
+		talloc_free(last);
+		emsmdbp_ctx->folder_cache_count--;
+	}
+	DLIST_ADD(emsmdbp_ctx->folder_cache, entry);
+	emsmdbp_ctx->folder_cache_count++;
+
+	return entry;
+}
+
+
+/**
+   \details Remember the parent of a folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox the folder belongs to
+   \param fid the folder identifier
+   \param parent_fid the parent folder identifier
+ */
+_PUBLIC_ void emsmdbp_folder_cache_set_parent(struct emsmdbp_context *emsmdbp_ctx, const char *owner,
+					      uint64_t fid, uint64_t parent_fid)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner) return;
+
+	entry = emsmdbp_folder_cache_add(emsmdbp_ctx, owner, fid);
+	if (!entry) return;
+	entry->parent_fid = parent_fid;
+	entry->parent_known = true;
+}
+
+
+/**
+   \details Retrieve the folder object open for a folder, to be used
+   as the parent of another folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox the folder belongs to
+   \param fid the folder identifier
+
+   \return the folder object, NULL if none is open
+ */
+_PUBLIC_ struct emsmdbp_object *emsmdbp_folder_cache_get_object(struct emsmdbp_context *emsmdbp_ctx,
+								 const char *owner, uint64_t fid)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner) return NULL;
+
+	entry = emsmdbp_folder_cache_find(emsmdbp_ctx, owner, fid);
+	if (!entry) return NULL;
+
+	return entry->object;
+}
+
+
+/**
+   \details Make a newly opened folder object available to the next
+   openings of its subfolders
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox the folder belongs to
+   \param object the folder object
+ */
+_PUBLIC_ void emsmdbp_folder_cache_set_object(struct emsmdbp_context *emsmdbp_ctx, const char *owner,
+					      struct emsmdbp_object *object)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner || !object) return;
+	if (object->type != EMSMDBP_OBJECT_FOLDER || object->object.folder->cache_entry) return;
+
+	entry = emsmdbp_folder_cache_add(emsmdbp_ctx, owner, object->object.folder->folderID);
+	if (!entry) return;
+
+	/* an object already there is still good, keep it */
+	if (entry->object) return;
+
+	entry->object = object;
+	object->object.folder->cache_entry = entry;
+}
+
+
+/**
+   \details Remove a folder object from the cache when it is freed
+
+   \param object the folder object
+ */
+_PUBLIC_ void emsmdbp_folder_cache_forget_object(struct emsmdbp_object *object)
+{
+	if (!object || object->type != EMSMDBP_OBJECT_FOLDER || !object->object.folder) return;
+	if (!object->object.folder->cache_entry) return;
+
+	object->object.folder->cache_entry->object = NULL;
+	object->object.folder->cache_entry = NULL;
+}
+
+
+/**
+   \details Forget every parent and folder object known to the session,
+   after the hierarchy changed
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_folder_cache_reset(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_folder_cache	*entry;
+
+	if (!emsmdbp_ctx) return;
+
+	while ((entry = emsmdbp_ctx->folder_cache)) {
+		DLIST_REMOVE(emsmdbp_ctx->folder_cache, entry);
+		talloc_free(entry);
+	}
+	emsmdbp_ctx->folder_cache_count = 0;
+}
+
+
+/**
+   \details Forget the hierarchy known to the session when another
+   session moved or deleted a folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param notify the notification received
+ */
+_PUBLIC_ void emsmdbp_folder_cache_notify(struct emsmdbp_context *emsmdbp_ctx, const struct Notify_repl *notify)
+{
+	if (!emsmdbp_ctx || !notify || !emsmdbp_ctx->folder_cache) return;
+
+	switch (notify->NotificationType) {
+	case 0x0008: /* folder deleted */
+	case 0x0020: /* folder moved */
+	case 0x0100: /* hierarchy table changed */
+		emsmdbp_folder_cache_reset(emsmdbp_ctx);
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,365 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_idle.c
+
+   \brief Hibernation of idle sessions
+
+   Outlook keeps its sessions open for hours without using them. When
+   a session goes emsmdb:session_idle_timeout minutes without a call,
+   its caches are dropped, its pending submissions and deletions are
+   flushed, and the backend objects of its folders and read-only
+   messages are released, along with the mapistore contexts they hold.
+
+   The emsmdbp objects and their handles stay: the folder and message
+   identifiers and the parent of each object are enough to reopen the
+   backend objects, which is done at the beginning of the next call.
+   An object which can't be reopened, because its folder or message
+   was deleted meanwhile, loses its handle.
+
+   The state of tables, streams, attachments, fast transfer and
+   synchronization contexts and messages open for writing lives in
+   their backend object. The mapistore context of such an object stays
+   open, with every object under it.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+static bool	emsmdbp_idle_initialized = false;
+static int	emsmdbp_idle_timeout = 0;
+
+static void emsmdbp_idle_handler(struct tevent_context *, struct tevent_timer *, struct timeval, void *);
+
+static void emsmdbp_idle_init(struct loadparm_context *lp_ctx)
+{
+	if (emsmdbp_idle_initialized) return;
+	emsmdbp_idle_initialized = true;
+
+	emsmdbp_idle_timeout = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "session_idle_timeout", 0);
+	if (emsmdbp_idle_timeout < 0) {
+		emsmdbp_idle_timeout = 0;
+	}
+}
+
+
+/**
+   \details Tell whether the backend object of an object can be
+   released and reopened later
+ */
+static bool emsmdbp_idle_reopenable(struct emsmdbp_object *object)
+{
+	switch (object->type) {
+	case EMSMDBP_OBJECT_MAILBOX:
+	case EMSMDBP_OBJECT_FOLDER:
+	case EMSMDBP_OBJECT_SUBSCRIPTION:
+		return true;
+	case EMSMDBP_OBJECT_MESSAGE:
+		return !object->object.message->read_write;
+	default:
+		return false;
+	}
+}
+
+
+static uint32_t emsmdbp_idle_depth(struct emsmdbp_object *object)
+{
+	uint32_t	depth = 0;
+
+	for (; object->parent_object; object = object->parent_object) {
+		depth++;
+	}
+
+	return depth;
+}
+
+
+/* Children first, so no backend object outlives its parent */
+static int emsmdbp_idle_cmp(const void *a, const void *b)
+{
+	uint32_t	depth_a = emsmdbp_idle_depth(*(struct emsmdbp_object **) a);
+	uint32_t	depth_b = emsmdbp_idle_depth(*(struct emsmdbp_object **) b);
+
+	if (depth_a == depth_b) return 0;
+
+	return (depth_a > depth_b) ? -1 : 1;
+}
+
+
+/**
+   \details Tell whether an object, or one of its parents, could not be
+   reopened
+ */
+static bool emsmdbp_idle_lost(struct emsmdbp_object *object)
+{
+	for (; object; object = object->parent_object) {
+		if (object->hibernated) return true;
+	}
+
+	return false;
+}
+
+
+/**
+   \details Drop what the session only keeps to go faster
+ */
+static void emsmdbp_idle_shed(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_propset		*propset;
+	struct emsmdbp_syncstate	*syncstate;
+	struct mapi_handles		*handle;
+	struct emsmdbp_object		*object;
+
+	while ((propset = emsmdbp_ctx->propsets)) {
+		DLIST_REMOVE(emsmdbp_ctx->propsets, propset);
+		talloc_free(propset);
+	}
+
+	while ((syncstate = emsmdbp_ctx->syncstates)) {
+		DLIST_REMOVE(emsmdbp_ctx->syncstates, syncstate);
+		talloc_free(syncstate);
+	}
+
+	emsmdbp_folder_cache_reset(emsmdbp_ctx);
+
+	for (handle = emsmdbp_ctx->handles_ctx->handles; handle; handle = handle->next) {
+		object = (struct emsmdbp_object *) handle->private_data;
+		if (object && object->type == EMSMDBP_OBJECT_TABLE) {
+			emsmdbp_object_table_cache_reset(object->object.table);
+		}
+	}
+}
+
+
+/**
+   \details Release the backend objects of an idle session, they are
+   reopened by the next emsmdbp_idle_touch
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_idle_hibernate(struct emsmdbp_context *emsmdbp_ctx)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct mapi_handles	*handle;
+	struct emsmdbp_object	*object;
+	struct emsmdbp_object	**objects = NULL;
+	struct emsmdbp_object	**grown;
+	uint32_t		*busy = NULL;
+	uint32_t		busy_count = 0;
+	uint32_t		count = 0;
+	uint32_t		contextID;
+	uint32_t		i;
+	bool			skip;
+
+	if (emsmdbp_ctx->hibernated || !emsmdbp_ctx->handles_ctx) return;
+
+	emsmdbp_submit_flush(emsmdbp_ctx);
+	emsmdbp_deferred_delete_flush(emsmdbp_ctx);
+	emsmdbp_idle_shed(emsmdbp_ctx);
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	/* Step 1. Find the contexts which have to stay open */
+	for (handle = emsmdbp_ctx->handles_ctx->handles; handle; handle = handle->next) {
+		object = (struct emsmdbp_object *) handle->private_data;
+		if (!object || !emsmdbp_is_mapistore(object) || emsmdbp_idle_reopenable(object)) continue;
+
+		busy = talloc_realloc(mem_ctx, busy, uint32_t, busy_count + 1);
+		if (!busy) goto end;
+		busy[busy_count++] = emsmdbp_get_contextID(object);
+	}
+
+	/* Step 2. Collect the objects of the other contexts, with the
+	   parents they hold */
+	for (handle = emsmdbp_ctx->handles_ctx->handles; handle; handle = handle->next) {
+		for (object = (struct emsmdbp_object *) handle->private_data;
+		     object && emsmdbp_is_mapistore(object) && !object->hibernated;
+		     object = object->parent_object) {
+			contextID = emsmdbp_get_contextID(object);
+			for (i = 0, skip = !emsmdbp_idle_reopenable(object); i < busy_count && !skip; i++) {
+				skip = (busy[i] == contextID);
+			}
+			if (skip) break;
+			if (!object->backend_object) continue;
+
+			grown = talloc_realloc(mem_ctx, objects, struct emsmdbp_object *, count + 1);
+			if (!grown) goto end;
+			objects = grown;
+			objects[count++] = object;
+			object->hibernated = true;
+		}
+	}
+
+	if (!count) goto end;
+
+	/* Step 3. Release them, children first */
+	qsort(objects, count, sizeof (struct emsmdbp_object *), emsmdbp_idle_cmp);
+	for (i = 0; i < count; i++) {
+		object = objects[i];
+		if (object->type == EMSMDBP_OBJECT_FOLDER && object->object.folder->mapistore_root) {
+			/* the backend object belongs to the context */
+			mapistore_del_context(emsmdbp_ctx->mstore_ctx, object->object.folder->contextID);
+		} else {
+			talloc_unlink(object, object->backend_object);
+		}
+		object->backend_object = NULL;
+	}
+
+	emsmdbp_ctx->hibernated = talloc_steal(emsmdbp_ctx, objects);
+	emsmdbp_ctx->hibernated_count = count;
+	objects = NULL;
+
+	OC_DEBUG(3, "session of %s hibernated, %u backend objects released", emsmdbp_ctx->username, count);
+
+end:
+	/* Objects collected before a failure are left as they were */
+	for (i = 0; objects && i < count; i++) {
+		objects[i]->hibernated = false;
+	}
+	talloc_free(mem_ctx);
+}
+
+
+/**
+   \details Reopen the backend objects of a hibernated session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+static void emsmdbp_idle_wake(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_object	*object;
+	struct mapi_handles	*handle;
+	enum mapistore_error	retval;
+	uint32_t		lost = 0;
+	uint32_t		i;
+	bool			found;
+
+	/* Parents first */
+	for (i = emsmdbp_ctx->hibernated_count; i > 0; i--) {
+		object = emsmdbp_ctx->hibernated[i - 1];
+		if (emsmdbp_idle_lost(object->parent_object)) {
+			lost++;
+			continue;
+		}
+		retval = emsmdbp_object_reopen(emsmdbp_ctx, object);
+		if (retval != MAPISTORE_SUCCESS) {
+			OC_DEBUG(1, "unable to reopen %s object: %s", emsmdbp_getstr_type(object), mapistore_errstr(retval));
+			lost++;
+			continue;
+		}
+		object->hibernated = false;
+	}
+
+	talloc_free(emsmdbp_ctx->hibernated);
+	emsmdbp_ctx->hibernated = NULL;
+	emsmdbp_ctx->hibernated_count = 0;
+
+	/* The client gets ecNullObject for what disappeared */
+	do {
+		found = false;
+		for (handle = emsmdbp_ctx->handles_ctx->handles; lost && handle; handle = handle->next) {
+			object = (struct emsmdbp_object *) handle->private_data;
+			if (object && emsmdbp_idle_lost(object)) {
+				mapi_handles_delete(emsmdbp_ctx->handles_ctx, handle->handle);
+				found = true;
+				break;
+			}
+		}
+	} while (found);
+
+	OC_DEBUG(3, "session of %s resumed, %u objects lost", emsmdbp_ctx->username, lost);
+}
+
+
+static void emsmdbp_idle_schedule(struct emsmdbp_context *emsmdbp_ctx)
+{
+	emsmdbp_ctx->idle_timer = tevent_add_timer(emsmdbp_ctx->ev_ctx, emsmdbp_ctx,
+						   tevent_timeval_set(emsmdbp_ctx->idle_since + emsmdbp_idle_timeout * 60, 0),
+						   emsmdbp_idle_handler, emsmdbp_ctx);
+	if (!emsmdbp_ctx->idle_timer) {
+		OC_DEBUG(1, "unable to schedule the hibernation of the session of %s", emsmdbp_ctx->username);
+	}
+}
+
+
+static void emsmdbp_idle_handler(struct tevent_context *ev, struct tevent_timer *te,
+				 struct timeval current_time, void *private_data)
+{
+	struct emsmdbp_context	*emsmdbp_ctx = talloc_get_type_abort(private_data, struct emsmdbp_context);
+
+	/* the timer is freed by tevent once it fired */
+	emsmdbp_ctx->idle_timer = NULL;
+
+	/* A call came in since the timer was armed */
+	if (current_time.tv_sec < emsmdbp_ctx->idle_since + emsmdbp_idle_timeout * 60) {
+		emsmdbp_idle_schedule(emsmdbp_ctx);
+		return;
+	}
+
+	emsmdbp_idle_hibernate(emsmdbp_ctx);
+}
+
+
+/**
+   \details Record a call of the session, reopening its backend objects
+   if it was hibernated
+
+   The timer is only armed when calls are run from the event loop, so
+   it can't fire in the middle of one.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_idle_touch(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx) return;
+
+	emsmdbp_idle_init(emsmdbp_ctx->lp_ctx);
+	if (emsmdbp_ctx->hibernated) {
+		emsmdbp_idle_wake(emsmdbp_ctx);
+	}
+
+	if (!emsmdbp_idle_timeout || !emsmdbp_ctx->ev_ctx || emsmdbp_threads_enabled()) return;
+
+	emsmdbp_ctx->idle_since = time(NULL);
+	if (!emsmdbp_ctx->idle_timer) {
+		emsmdbp_idle_schedule(emsmdbp_ctx);
+	}
+}
+
+
+/**
+   \details Stop watching a session which is being released
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_idle_release(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx) return;
+
+	if (emsmdbp_ctx->idle_timer) {
+		talloc_free(emsmdbp_ctx->idle_timer);
+		emsmdbp_ctx->idle_timer = NULL;
+	}
+}
@@ -0,0 +1,209 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_load.c
+
+   \brief Per-worker load tracking and admission control
+
+   Every worker process tracks its load: the emsmdb calls in flight,
+   the calls queued for its worker threads and a moving average of the
+   time ROPs spend in the backends. Once any of them reaches its limit
+   (emsmdb:backoff_latency, emsmdb:backoff_in_flight and
+   emsmdb:backoff_queue_depth), bulk ROPs (see emsmdbp_sched.c) are
+   refused with ecServerBusy and the response carries a RopBackoff
+   telling the client how long to wait before sending them again.
+   Every other ROP is always processed, so mailboxes stay responsive
+   while the backends catch up.
+
+   The load is only updated with the emsmdb lock held, so it needs no
+   locking of its own.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* The latency average gives each new sample a weight of 1/8 */
+#define	EMSMDBP_LOAD_EWMA_SHIFT		3
+
+/* Backoff durations never exceed this many times emsmdb:backoff_time */
+#define	EMSMDBP_LOAD_MAX_FACTOR		8
+
+static bool	emsmdbp_load_initialized = false;
+static bool	emsmdbp_load_enabled = false;
+static uint64_t	emsmdbp_load_max_latency = 0;
+static uint32_t	emsmdbp_load_max_in_flight = 0;
+static uint32_t	emsmdbp_load_max_queue_depth = 0;
+static uint32_t	emsmdbp_load_backoff_time = 1000;
+
+static uint32_t	emsmdbp_load_in_flight = 0;
+static uint64_t	emsmdbp_load_latency = 0;
+static time_t	emsmdbp_load_sampled = 0;
+
+static uint32_t emsmdbp_load_parm(struct loadparm_context *lp_ctx, const char *option, int default_v)
+{
+	int	value;
+
+	value = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", option, default_v);
+	return (value > 0) ? value : 0;
+}
+
+static void emsmdbp_load_init(struct loadparm_context *lp_ctx)
+{
+	if (emsmdbp_load_initialized) return;
+	emsmdbp_load_initialized = true;
+
+	emsmdbp_load_max_latency = (uint64_t) emsmdbp_load_parm(lp_ctx, "backoff_latency", 0) * 1000;
+	emsmdbp_load_max_in_flight = emsmdbp_load_parm(lp_ctx, "backoff_in_flight", 0);
+	emsmdbp_load_max_queue_depth = emsmdbp_load_parm(lp_ctx, "backoff_queue_depth", 0);
+	emsmdbp_load_backoff_time = emsmdbp_load_parm(lp_ctx, "backoff_time", 1000);
+
+	emsmdbp_load_enabled = (emsmdbp_load_max_latency || emsmdbp_load_max_in_flight ||
+				emsmdbp_load_max_queue_depth);
+	if (emsmdbp_load_enabled && !emsmdbp_load_backoff_time) {
+		emsmdbp_load_backoff_time = 1;
+	}
+}
+
+
+/**
+   \details Account the beginning of an emsmdb call
+
+   \param lp_ctx pointer to the loadparm context
+
+   \return true if admission control is enabled, in which case
+   emsmdbp_load_end must be called once the call is processed
+ */
+_PUBLIC_ bool emsmdbp_load_begin(struct loadparm_context *lp_ctx)
+{
+	emsmdbp_load_init(lp_ctx);
+	if (!emsmdbp_load_enabled) return false;
+
+	emsmdbp_load_in_flight++;
+	return true;
+}
+
+
+/**
+   \details Account the end of an emsmdb call started with
+   emsmdbp_load_begin
+ */
+_PUBLIC_ void emsmdbp_load_end(void)
+{
+	if (emsmdbp_load_in_flight) {
+		emsmdbp_load_in_flight--;
+	}
+}
+
+
+/**
+   \details Add the latency of a processed ROP to the backend latency
+   average
+
+   \param start pointer to the timestamp taken with
+   emsmdbp_stats_start before processing the ROP
+ */
+_PUBLIC_ void emsmdbp_load_rop(const struct timespec *start)
+{
+	struct timespec	end;
+	int64_t		usec;
+
+	if (!emsmdbp_load_enabled) return;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usec = (int64_t)(end.tv_sec - start->tv_sec) * 1000000 +
+		(end.tv_nsec - start->tv_nsec) / 1000;
+	if (usec < 0) usec = 0;
+
+	emsmdbp_load_latency += (usec - (int64_t) emsmdbp_load_latency) >> EMSMDBP_LOAD_EWMA_SHIFT;
+	emsmdbp_load_sampled = end.tv_sec;
+}
+
+
+/**
+   \details Return the load of the worker relative to its limits, in
+   thousandths: 1000 and above means overloaded
+ */
+static uint32_t emsmdbp_load_pressure(void)
+{
+	struct timespec	now;
+	uint64_t	pressure = 0;
+	uint64_t	value;
+	time_t		elapsed;
+
+	/* The average only moves when ROPs are processed: let it decay,
+	   halving every second without samples, so refused ROPs are
+	   admitted again once the backends are left alone */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = now.tv_sec - emsmdbp_load_sampled;
+	if (emsmdbp_load_latency && elapsed > 0) {
+		emsmdbp_load_latency = (elapsed < 64) ? emsmdbp_load_latency >> elapsed : 0;
+		emsmdbp_load_sampled = now.tv_sec;
+	}
+
+	if (emsmdbp_load_max_latency) {
+		value = emsmdbp_load_latency * 1000 / emsmdbp_load_max_latency;
+		if (value > pressure) pressure = value;
+	}
+	if (emsmdbp_load_max_in_flight) {
+		value = (uint64_t) emsmdbp_load_in_flight * 1000 / emsmdbp_load_max_in_flight;
+		if (value > pressure) pressure = value;
+	}
+	if (emsmdbp_load_max_queue_depth) {
+		value = (uint64_t) emsmdbp_threads_queue_depth() * 1000 / emsmdbp_load_max_queue_depth;
+		if (value > pressure) pressure = value;
+	}
+
+	return (pressure > UINT32_MAX) ? UINT32_MAX : pressure;
+}
+
+
+/**
+   \details Decide whether a ROP is processed or delayed
+
+   The backoff grows with the load, from emsmdb:backoff_time at the
+   limit up to EMSMDBP_LOAD_MAX_FACTOR times that.
+
+   \param mapi_req pointer to the ROP request
+
+   \return 0 if the ROP is processed, otherwise the number of
+   milliseconds the client should wait before sending it again
+ */
+_PUBLIC_ uint32_t emsmdbp_load_backoff(const struct EcDoRpc_MAPI_REQ *mapi_req)
+{
+	uint64_t	pressure;
+	uint64_t	duration;
+
+	if (!emsmdbp_load_enabled || !mapi_req) return 0;
+	if (!emsmdbp_sched_bulk_rop(mapi_req)) return 0;
+
+	pressure = emsmdbp_load_pressure();
+	if (pressure < 1000) return 0;
+
+	if (pressure > 1000 * EMSMDBP_LOAD_MAX_FACTOR) {
+		pressure = 1000 * EMSMDBP_LOAD_MAX_FACTOR;
+	}
+	duration = (uint64_t) emsmdbp_load_backoff_time * pressure / 1000;
+
+	return (duration > UINT32_MAX) ? UINT32_MAX : duration;
+}
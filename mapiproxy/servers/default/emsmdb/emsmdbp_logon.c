@@ -0,0 +1,415 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_logon.c
+
+   \brief Cached mailbox logon records
+
+   A private logon provisions the mailbox and then reads the special
+   folder identifiers, the mailbox GUID and the replica information
+   from openchangedb, one query each. When emsmdb:logon_cache_ttl is
+   set, all of them are kept in a logon record, in the worker process
+   and in memcached, and logons served from a valid record skip both
+   the provisioning check and the queries.
+
+   A record is valid for logon_cache_ttl seconds after the mailbox was
+   verified, as long as its version matches the mailbox version kept in
+   memcached. emsmdbp_logon_record_invalidate bumps that version, so
+   every process verifies the mailbox again on the next logon.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+#define	EMSMDBP_LOGON_RECORD_KEY	"logon_record:%s"
+#define	EMSMDBP_LOGON_VERSION_KEY	"logon_version:%s"
+#define	EMSMDBP_LOGON_RECORD_FORMAT	1
+
+/* Folders returned by RopLogon, in the order they are stored */
+static const enum emsmdbp_mailbox_systemidx logon_folders[EMSMDBP_LOGON_RECORD_FOLDERS] = {
+	EMSMDBP_MAILBOX_ROOT,
+	EMSMDBP_DEFERRED_ACTION,
+	EMSMDBP_SPOOLER_QUEUE,
+	EMSMDBP_TOP_INFORMATION_STORE,
+	EMSMDBP_INBOX,
+	EMSMDBP_OUTBOX,
+	EMSMDBP_SENT_ITEMS,
+	EMSMDBP_DELETED_ITEMS,
+	EMSMDBP_COMMON_VIEWS,
+	EMSMDBP_SCHEDULE,
+	EMSMDBP_SEARCH,
+	EMSMDBP_VIEWS,
+	EMSMDBP_SHORTCUTS
+};
+
+struct emsmdbp_logon_cache_entry {
+	struct emsmdbp_logon_cache_entry	*prev;
+	struct emsmdbp_logon_cache_entry	*next;
+	char					*username;
+	struct emsmdbp_logon_record		record;
+};
+
+static struct emsmdbp_logon_cache_entry	*logon_cache = NULL;
+
+
+static memcached_st *emsmdbp_logon_memc(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx->mstore_ctx || !emsmdbp_ctx->mstore_ctx->notification_ctx) {
+		return NULL;
+	}
+	return emsmdbp_ctx->mstore_ctx->notification_ctx->memc_ctx;
+}
+
+
+/**
+   \details Retrieve the current version of a mailbox, 0 if none was
+   recorded or memcached is not available
+ */
+static uint32_t emsmdbp_logon_version(TALLOC_CTX *mem_ctx, memcached_st *memc, const char *username)
+{
+	memcached_return_t	rc;
+	char			*key, *value;
+	size_t			value_len;
+	uint32_t		flags, version = 0;
+
+	if (!memc) return 0;
+
+	key = talloc_asprintf(mem_ctx, EMSMDBP_LOGON_VERSION_KEY, username);
+	if (!key) return 0;
+
+	value = memcached_get(memc, key, strlen(key), &value_len, &flags, &rc);
+	if (rc == MEMCACHED_SUCCESS && value) {
+		version = strtoul(value, NULL, 10);
+	}
+	free(value);
+	talloc_free(key);
+
+	return version;
+}
+
+
+static void emsmdbp_logon_push_uint64(uint8_t **p, uint64_t value)
+{
+	int	i;
+
+	for (i = 0; i < 8; i++) {
+		*(*p)++ = (value >> (i * 8)) & 0xff;
+	}
+}
+
+
+static uint64_t emsmdbp_logon_pull_uint64(const uint8_t **p)
+{
+	uint64_t	value = 0;
+	int		i;
+
+	for (i = 0; i < 8; i++) {
+		value |= ((uint64_t) *(*p)++) << (i * 8);
+	}
+
+	return value;
+}
+
+
+static bool emsmdbp_logon_push_guid(TALLOC_CTX *mem_ctx, uint8_t **p, const struct GUID *guid)
+{
+	DATA_BLOB	blob;
+
+	if (!NT_STATUS_IS_OK(GUID_to_ndr_blob(guid, mem_ctx, &blob)) || blob.length != 16) {
+		return false;
+	}
+	memcpy(*p, blob.data, 16);
+	*p += 16;
+
+	return true;
+}
+
+
+static bool emsmdbp_logon_pull_guid(const uint8_t **p, struct GUID *guid)
+{
+	DATA_BLOB	blob;
+
+	blob.data = (uint8_t *) *p;
+	blob.length = 16;
+	*p += 16;
+
+	return NT_STATUS_IS_OK(GUID_from_ndr_blob(&blob, guid));
+}
+
+
+#define	EMSMDBP_LOGON_RECORD_SIZE	(1 + 4 + 8 + EMSMDBP_LOGON_RECORD_FOLDERS * 8 + 16 + 2 + 16)
+
+/**
+   \details Serialize a logon record to the little-endian layout stored
+   in memcached
+ */
+static bool emsmdbp_logon_record_pack(TALLOC_CTX *mem_ctx, const struct emsmdbp_logon_record *record, DATA_BLOB *blob)
+{
+	uint8_t		*p;
+	int		i;
+
+	blob->data = talloc_size(mem_ctx, EMSMDBP_LOGON_RECORD_SIZE);
+	if (!blob->data) return false;
+	blob->length = EMSMDBP_LOGON_RECORD_SIZE;
+
+	p = blob->data;
+	*p++ = EMSMDBP_LOGON_RECORD_FORMAT;
+	for (i = 0; i < 4; i++) {
+		*p++ = (record->version >> (i * 8)) & 0xff;
+	}
+	emsmdbp_logon_push_uint64(&p, (uint64_t) record->verified);
+	for (i = 0; i < EMSMDBP_LOGON_RECORD_FOLDERS; i++) {
+		emsmdbp_logon_push_uint64(&p, record->folders[i]);
+	}
+	if (!emsmdbp_logon_push_guid(mem_ctx, &p, &record->MailboxGuid)) return false;
+	*p++ = record->ReplId & 0xff;
+	*p++ = (record->ReplId >> 8) & 0xff;
+	if (!emsmdbp_logon_push_guid(mem_ctx, &p, &record->ReplGUID)) return false;
+
+	return true;
+}
+
+
+static bool emsmdbp_logon_record_unpack(const uint8_t *data, size_t length, struct emsmdbp_logon_record *record)
+{
+	const uint8_t	*p = data;
+	int		i;
+
+	if (length != EMSMDBP_LOGON_RECORD_SIZE || *p++ != EMSMDBP_LOGON_RECORD_FORMAT) {
+		return false;
+	}
+
+	record->version = 0;
+	for (i = 0; i < 4; i++) {
+		record->version |= ((uint32_t) *p++) << (i * 8);
+	}
+	record->verified = (time_t) emsmdbp_logon_pull_uint64(&p);
+	for (i = 0; i < EMSMDBP_LOGON_RECORD_FOLDERS; i++) {
+		record->folders[i] = emsmdbp_logon_pull_uint64(&p);
+	}
+	if (!emsmdbp_logon_pull_guid(&p, &record->MailboxGuid)) return false;
+	record->ReplId = p[0] | (p[1] << 8);
+	p += 2;
+
+	return emsmdbp_logon_pull_guid(&p, &record->ReplGUID);
+}
+
+
+static struct emsmdbp_logon_cache_entry *emsmdbp_logon_cache_find(const char *username)
+{
+	struct emsmdbp_logon_cache_entry	*entry;
+
+	for (entry = logon_cache; entry; entry = entry->next) {
+		if (!strcmp(entry->username, username)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void emsmdbp_logon_cache_store(const char *username, const struct emsmdbp_logon_record *record)
+{
+	struct emsmdbp_logon_cache_entry	*entry;
+
+	entry = emsmdbp_logon_cache_find(username);
+	if (!entry) {
+		entry = talloc_zero(NULL, struct emsmdbp_logon_cache_entry);
+		if (!entry) return;
+		entry->username = talloc_strdup(entry, username);
+		if (!entry->username) {
+			talloc_free(entry);
+			return;
+		}
+		DLIST_ADD(logon_cache, entry);
+	}
+	entry->record = *record;
+}
+
+
+static bool emsmdbp_logon_record_valid(const struct emsmdbp_logon_record *record, uint32_t version, int ttl)
+{
+	return (record->version == version && time(NULL) - record->verified < ttl);
+}
+
+
+/**
+   \details Provision the mailbox and read its logon record from
+   openchangedb
+ */
+static enum MAPISTATUS emsmdbp_logon_record_load(struct emsmdbp_context *emsmdbp_ctx, const char *username,
+						 const char *EssDN, struct emsmdbp_logon_record *record)
+{
+	enum MAPISTATUS		ret;
+	int			i;
+
+	ret = emsmdbp_mailbox_provision(emsmdbp_ctx, username);
+	OPENCHANGE_RETVAL_IF(ret != MAPI_E_SUCCESS, ret, NULL);
+	/* TODO: freebusy entry should be created only during freebusy lookups */
+	if (strncmp(username, emsmdbp_ctx->username, strlen(username)) == 0) {
+		ret = emsmdbp_mailbox_provision_public_freebusy(emsmdbp_ctx, EssDN);
+		OPENCHANGE_RETVAL_IF(ret != MAPI_E_SUCCESS, ret, NULL);
+	}
+
+	for (i = 0; i < EMSMDBP_LOGON_RECORD_FOLDERS; i++) {
+		openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, logon_folders[i], &record->folders[i]);
+	}
+	openchangedb_get_MailboxGuid(emsmdbp_ctx->oc_ctx, username, &record->MailboxGuid);
+	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username, &record->ReplId, &record->ReplGUID);
+	record->verified = time(NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the logon record of a mailbox, provisioning the
+   mailbox when no valid cached record exists
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param username the owner of the mailbox
+   \param EssDN the distinguished name used to log on
+   \param record pointer to the logon record to fill
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_logon_record_get(struct emsmdbp_context *emsmdbp_ctx, const char *username,
+						  const char *EssDN, struct emsmdbp_logon_record *record)
+{
+	TALLOC_CTX				*mem_ctx;
+	struct emsmdbp_logon_cache_entry	*entry;
+	memcached_st				*memc;
+	memcached_return_t			rc;
+	enum MAPISTATUS				ret;
+	DATA_BLOB				blob;
+	char					*key, *value;
+	size_t					value_len;
+	uint32_t				flags, version;
+	int					ttl;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!username || !record, MAPI_E_INVALID_PARAMETER, NULL);
+
+	memset(record, 0, sizeof (struct emsmdbp_logon_record));
+
+	ttl = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "logon_cache_ttl", 0);
+	if (ttl <= 0) {
+		return emsmdbp_logon_record_load(emsmdbp_ctx, username, EssDN, record);
+	}
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	memc = emsmdbp_logon_memc(emsmdbp_ctx);
+	version = emsmdbp_logon_version(mem_ctx, memc, username);
+
+	/* Step 1. Record of the worker process */
+	entry = emsmdbp_logon_cache_find(username);
+	if (entry && emsmdbp_logon_record_valid(&entry->record, version, ttl)) {
+		*record = entry->record;
+		talloc_free(mem_ctx);
+		return MAPI_E_SUCCESS;
+	}
+
+	/* Step 2. Record shared through memcached */
+	key = talloc_asprintf(mem_ctx, EMSMDBP_LOGON_RECORD_KEY, username);
+	OPENCHANGE_RETVAL_IF(!key, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	if (memc) {
+		value = memcached_get(memc, key, strlen(key), &value_len, &flags, &rc);
+		if (rc == MEMCACHED_SUCCESS && value &&
+		    emsmdbp_logon_record_unpack((uint8_t *) value, value_len, record) &&
+		    emsmdbp_logon_record_valid(record, version, ttl)) {
+			free(value);
+			emsmdbp_logon_cache_store(username, record);
+			talloc_free(mem_ctx);
+			return MAPI_E_SUCCESS;
+		}
+		free(value);
+	}
+
+	/* Step 3. Verify the mailbox and build a new record */
+	OC_DEBUG(5, "building logon record of %s (version %"PRIu32")", username, version);
+	memset(record, 0, sizeof (struct emsmdbp_logon_record));
+	ret = emsmdbp_logon_record_load(emsmdbp_ctx, username, EssDN, record);
+	OPENCHANGE_RETVAL_IF(ret != MAPI_E_SUCCESS, ret, mem_ctx);
+	record->version = version;
+
+	emsmdbp_logon_cache_store(username, record);
+	if (memc && emsmdbp_logon_record_pack(mem_ctx, record, &blob)) {
+		rc = memcached_set(memc, key, strlen(key), (char *) blob.data, blob.length, ttl, 0);
+		if (rc != MEMCACHED_SUCCESS) {
+			OC_DEBUG(5, "unable to store logon record of %s: %s", username, memcached_strerror(memc, rc));
+		}
+	}
+
+	talloc_free(mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Invalidate the logon records of a mailbox, so the next
+   logon verifies it again
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param username the owner of the mailbox
+ */
+_PUBLIC_ void emsmdbp_logon_record_invalidate(struct emsmdbp_context *emsmdbp_ctx, const char *username)
+{
+	struct emsmdbp_logon_cache_entry	*entry;
+	memcached_st				*memc;
+	memcached_return_t			rc;
+	uint64_t				value;
+	char					*key;
+
+	if (!emsmdbp_ctx || !username) return;
+
+	entry = emsmdbp_logon_cache_find(username);
+	if (entry) {
+		DLIST_REMOVE(logon_cache, entry);
+		talloc_free(entry);
+	}
+
+	memc = emsmdbp_logon_memc(emsmdbp_ctx);
+	if (!memc) return;
+
+	key = talloc_asprintf(NULL, EMSMDBP_LOGON_VERSION_KEY, username);
+	if (!key) return;
+
+	rc = memcached_increment(memc, key, strlen(key), 1, &value);
+	if (rc == MEMCACHED_NOTFOUND) {
+		rc = memcached_add(memc, key, strlen(key), "1", 1, 0, 0);
+		/* Added by another process in the meantime */
+		if (rc == MEMCACHED_NOTSTORED) {
+			rc = memcached_increment(memc, key, strlen(key), 1, &value);
+		}
+	}
+	if (rc != MEMCACHED_SUCCESS && rc != MEMCACHED_STORED) {
+		OC_DEBUG(3, "unable to bump logon version of %s: %s", username, memcached_strerror(memc, rc));
+	}
+
+	talloc_free(key);
+}
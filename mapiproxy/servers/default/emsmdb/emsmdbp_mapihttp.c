@@ -0,0 +1,1112 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_mapihttp.c
+
+   \brief MAPI over HTTP endpoint (MS-OXCMAPIHTTP)
+
+   When emsmdb:mapihttp is set, the emsmdb server forks a process
+   answering the Connect, Execute, Disconnect and NotificationWait
+   requests POSTed to /mapi/emsmdb/. Each request is a single HTTP
+   exchange: there is no RPC proxy in between nor long-lived IN/OUT
+   channels. The ROP buffer of an Execute request goes through the
+   same processing as the one of an EcDoRpcExt2 call.
+
+   Sessions are identified by the MapiContext cookie, which is the
+   UUID the session is registered under in the emsmdb session
+   registry. Sessions not used for emsmdb:mapihttp_session_timeout
+   seconds are released.
+
+   The endpoint does not authenticate users itself: it is meant to
+   listen on the loopback behind a front-end web server which
+   authenticates the requests and passes the account name in the
+   emsmdb:mapihttp_user_header header.
+
+   With emsmdb:mapihttp_workers, several processes accept connections
+   on the listening socket. The sessions of a user all live in the
+   worker the account name hashes to, which is the only one opening
+   its mailbox: a worker reading a request for another user passes
+   the connection, with the bytes read so far, to the worker owning
+   the user over a datagram socket. Sessions and handle tables are
+   never shared between processes.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <ctype.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+#define	EMSMDBP_MAPIHTTP_LISTEN			"127.0.0.1:8008"
+#define	EMSMDBP_MAPIHTTP_USER_HEADER		"X-Remote-User"
+#define	EMSMDBP_MAPIHTTP_SESSION_TIMEOUT	900
+#define	EMSMDBP_MAPIHTTP_NOTIFICATION_WAIT	300
+#define	EMSMDBP_MAPIHTTP_MAX_REQUEST		(4 * 1024 * 1024)
+#define	EMSMDBP_MAPIHTTP_MAX_HEADERS		(16 * 1024)
+#define	EMSMDBP_MAPIHTTP_READ_SIZE		8192
+#define	EMSMDBP_MAPIHTTP_MAX_WORKERS		64
+
+/* X-ResponseCode values, see MS-OXCMAPIHTTP 2.2.3.3.3 */
+enum emsmdbp_mapihttp_code {
+	MAPIHTTP_SUCCESS = 0,
+	MAPIHTTP_UNKNOWN_FAILURE = 1,
+	MAPIHTTP_INVALID_VERB = 2,
+	MAPIHTTP_INVALID_PATH = 3,
+	MAPIHTTP_INVALID_REQUEST_TYPE = 5,
+	MAPIHTTP_ANONYMOUS_NOT_ALLOWED = 8,
+	MAPIHTTP_TOO_LARGE = 9,
+	MAPIHTTP_CONTEXT_NOT_FOUND = 10,
+	MAPIHTTP_INVALID_REQUEST_BODY = 12,
+	MAPIHTTP_MISSING_COOKIE = 13
+};
+
+struct emsmdbp_mapihttp_session {
+	struct emsmdbp_mapihttp_session		*prev;
+	struct emsmdbp_mapihttp_session		*next;
+	struct GUID				cookie;
+	char					*username;
+	time_t					used;
+};
+
+struct emsmdbp_mapihttp_request {
+	char					*method;
+	char					*path;
+	char					*request_type;
+	char					*request_id;
+	char					*client_info;
+	char					*cookie;
+	char					*username;
+	size_t					content_length;
+	bool					keep_alive;
+	DATA_BLOB				body;
+};
+
+struct emsmdbp_mapihttp;
+
+struct emsmdbp_mapihttp_connection {
+	struct emsmdbp_mapihttp_connection	*prev;
+	struct emsmdbp_mapihttp_connection	*next;
+	struct emsmdbp_mapihttp			*server;
+	int					fd;
+	struct tevent_fd			*fde;
+	DATA_BLOB				in;
+	size_t					headers_length;
+	struct emsmdbp_mapihttp_request		*request;
+	DATA_BLOB				out;
+	size_t					sent;
+	bool					keep_alive;
+	struct timeval				started;
+	struct tevent_timer			*wait_timer;
+	time_t					wait_deadline;
+};
+
+struct emsmdbp_mapihttp {
+	struct loadparm_context			*lp_ctx;
+	struct tevent_context			*ev;
+	int					fd;
+	const char				*user_header;
+	int					session_timeout;
+	int					notification_wait;
+	struct server_id			server_id;
+	uint32_t				context_id;
+	int					worker;
+	int					workers;
+	int					channel;	/* connections passed to this worker */
+	int					*channels;	/* connections passed to each worker */
+	struct emsmdbp_mapihttp_session		*sessions;
+	struct emsmdbp_mapihttp_connection	*connections;
+};
+
+static void emsmdbp_mapihttp_connection_handler(struct tevent_context *, struct tevent_fd *, uint16_t, void *);
+
+
+static int emsmdbp_mapihttp_connection_destructor(struct emsmdbp_mapihttp_connection *conn)
+{
+	DLIST_REMOVE(conn->server->connections, conn);
+	if (conn->fd != -1) {
+		close(conn->fd);
+	}
+
+	return 0;
+}
+
+static struct emsmdbp_mapihttp_session *emsmdbp_mapihttp_session_find(struct emsmdbp_mapihttp *server,
+								      const char *cookie,
+								      struct GUID *uuid)
+{
+	struct emsmdbp_mapihttp_session	*session;
+
+	if (!cookie || !NT_STATUS_IS_OK(GUID_from_string(cookie, uuid))) return NULL;
+
+	for (session = server->sessions; session; session = session->next) {
+		if (GUID_equal(&session->cookie, uuid)) {
+			session->used = time(NULL);
+			return session;
+		}
+	}
+
+	return NULL;
+}
+
+static void emsmdbp_mapihttp_session_release(struct emsmdbp_mapihttp *server,
+					     struct emsmdbp_mapihttp_session *session)
+{
+	emsmdb_mapihttp_disconnect(&session->cookie, NULL);
+	DLIST_REMOVE(server->sessions, session);
+	talloc_free(session);
+}
+
+
+/**
+   \details Release the sessions the client stopped using
+ */
+static void emsmdbp_mapihttp_expire(struct tevent_context *ev, struct tevent_timer *te,
+				    struct timeval current_time, void *private_data)
+{
+	struct emsmdbp_mapihttp		*server = (struct emsmdbp_mapihttp *) private_data;
+	struct emsmdbp_mapihttp_session	*session;
+	struct emsmdbp_mapihttp_session	*next;
+	time_t				now;
+
+	now = time(NULL);
+	for (session = server->sessions; session; session = next) {
+		next = session->next;
+		if (now - session->used > server->session_timeout) {
+			OC_DEBUG(3, "[mapihttp]: session of %s expired", session->username);
+			emsmdbp_mapihttp_session_release(server, session);
+		}
+	}
+
+	tevent_add_timer(ev, server, timeval_current_ofs(60, 0), emsmdbp_mapihttp_expire, server);
+}
+
+
+/**
+   \details Queue an HTTP response on the connection
+
+   The body of a successful request starts with the PROCESSING and
+   DONE meta-tags, followed by the additional headers and the binary
+   response.
+
+   \param conn pointer to the connection
+   \param status the HTTP status
+   \param code the X-ResponseCode value
+   \param set_cookie the session cookie to set, or NULL
+   \param payload the binary response, or NULL
+ */
+static void emsmdbp_mapihttp_respond(struct emsmdbp_mapihttp_connection *conn,
+				     const char *status,
+				     enum emsmdbp_mapihttp_code code,
+				     const struct GUID *set_cookie,
+				     const DATA_BLOB *payload)
+{
+	struct emsmdbp_mapihttp_request	*request = conn->request;
+	char				*meta;
+	char				*headers;
+	char				start[64];
+	struct tm			tm;
+	time_t				t;
+	size_t				length;
+
+	t = conn->started.tv_sec;
+	gmtime_r(&t, &tm);
+	strftime(start, sizeof (start), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+	meta = talloc_asprintf(conn, "PROCESSING\r\nDONE\r\nX-ElapsedTime: %u\r\nX-StartTime: %s\r\n\r\n",
+			       (unsigned int) (timeval_elapsed(&conn->started) * 1000), start);
+	if (!meta) goto fatal;
+	length = strlen(meta) + (payload ? payload->length : 0);
+
+	headers = talloc_asprintf(conn, "HTTP/1.1 %s\r\n"
+				  "Content-Type: application/mapi-http\r\n"
+				  "Content-Length: %zu\r\n"
+				  "Cache-Control: private\r\n"
+				  "X-RequestType: %s\r\n"
+				  "X-RequestId: %s\r\n"
+				  "X-ClientInfo: %s\r\n"
+				  "X-ResponseCode: %d\r\n"
+				  "X-ServerApplication: Exchange/15.00.0847.4040\r\n"
+				  "X-PendingPeriod: 15000\r\n"
+				  "Connection: %s\r\n",
+				  status, length,
+				  (request && request->request_type) ? request->request_type : "",
+				  (request && request->request_id) ? request->request_id : "",
+				  (request && request->client_info) ? request->client_info : "",
+				  code, conn->keep_alive ? "keep-alive" : "close");
+	if (!headers) goto fatal;
+	if (set_cookie) {
+		headers = talloc_asprintf_append(headers, "Set-Cookie: MapiContext=%s; path=/mapi/emsmdb\r\n",
+						 GUID_string(conn, set_cookie));
+		if (!headers) goto fatal;
+	}
+	headers = talloc_strdup_append(headers, "\r\n");
+	if (!headers) goto fatal;
+
+	conn->out.length = strlen(headers) + length;
+	conn->out.data = talloc_array(conn, uint8_t, conn->out.length);
+	if (!conn->out.data) goto fatal;
+	memcpy(conn->out.data, headers, strlen(headers));
+	memcpy(conn->out.data + strlen(headers), meta, strlen(meta));
+	if (payload && payload->length) {
+		memcpy(conn->out.data + strlen(headers) + strlen(meta), payload->data, payload->length);
+	}
+	conn->sent = 0;
+	talloc_free(headers);
+	talloc_free(meta);
+
+	TEVENT_FD_WRITEABLE(conn->fde);
+	TEVENT_FD_NOT_READABLE(conn->fde);
+	return;
+
+fatal:
+	/* Close the connection once back in the event loop */
+	OC_DEBUG(0, "[mapihttp]: No more memory");
+	conn->keep_alive = false;
+	TALLOC_FREE(conn->out.data);
+	conn->out.length = 0;
+	TEVENT_FD_WRITEABLE(conn->fde);
+	TEVENT_FD_NOT_READABLE(conn->fde);
+}
+
+static struct ndr_push *emsmdbp_mapihttp_push_init(TALLOC_CTX *mem_ctx, uint32_t status, uint32_t error)
+{
+	struct ndr_push	*ndr;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	if (!ndr) return NULL;
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	ndr_push_uint32(ndr, NDR_SCALARS, status);
+	ndr_push_uint32(ndr, NDR_SCALARS, error);
+
+	return ndr;
+}
+
+static void emsmdbp_mapihttp_respond_ndr(struct emsmdbp_mapihttp_connection *conn,
+					 struct ndr_push *ndr,
+					 const struct GUID *set_cookie)
+{
+	DATA_BLOB	payload;
+
+	if (!ndr) {
+		emsmdbp_mapihttp_respond(conn, "500 Internal Server Error", MAPIHTTP_UNKNOWN_FAILURE, NULL, NULL);
+		return;
+	}
+
+	/* AuxiliaryBufferSize: no auxiliary blocks are returned */
+	ndr_push_uint32(ndr, NDR_SCALARS, 0);
+	payload = ndr_push_blob(ndr);
+	emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_SUCCESS, set_cookie, &payload);
+	talloc_free(ndr);
+}
+
+
+/**
+   \details Connect request type: log the user on and create the
+   session
+ */
+static void emsmdbp_mapihttp_connect(struct emsmdbp_mapihttp_connection *conn)
+{
+	struct emsmdbp_mapihttp		*server = conn->server;
+	struct emsmdbp_mapihttp_request	*request = conn->request;
+	struct emsmdbp_mapihttp_session	*session;
+	struct ndr_pull			*pull;
+	struct ndr_push			*push;
+	enum MAPISTATUS			retval;
+	const char			*userdn = NULL;
+	const char			*dnprefix = NULL;
+	const char			*display_name = NULL;
+	uint32_t			flags, codepage, lcid_sort, lcid_string;
+	struct GUID			cookie;
+	TALLOC_CTX			*mem_ctx;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) goto fatal;
+
+	pull = ndr_pull_init_blob(&request->body, mem_ctx);
+	if (!pull) goto fatal;
+	ndr_set_flags(&pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_STR_ASCII|LIBNDR_FLAG_STR_NULLTERM);
+	if (ndr_pull_string(pull, NDR_SCALARS, &userdn) != NDR_ERR_SUCCESS ||
+	    ndr_pull_uint32(pull, NDR_SCALARS, &flags) != NDR_ERR_SUCCESS ||
+	    ndr_pull_uint32(pull, NDR_SCALARS, &codepage) != NDR_ERR_SUCCESS ||
+	    ndr_pull_uint32(pull, NDR_SCALARS, &lcid_sort) != NDR_ERR_SUCCESS ||
+	    ndr_pull_uint32(pull, NDR_SCALARS, &lcid_string) != NDR_ERR_SUCCESS) {
+		emsmdbp_mapihttp_respond(conn, "400 Bad Request", MAPIHTTP_INVALID_REQUEST_BODY, NULL, NULL);
+		talloc_free(mem_ctx);
+		return;
+	}
+
+	retval = emsmdb_mapihttp_connect(mem_ctx, server->lp_ctx, server->ev, request->username, userdn,
+					 lcid_string, server->server_id, ++server->context_id, &cookie,
+					 &dnprefix, &display_name);
+	OC_DEBUG(3, "[mapihttp]: Connect of %s as %s: %s", request->username, userdn, mapi_get_errstr(retval));
+
+	push = emsmdbp_mapihttp_push_init(mem_ctx, 0, retval);
+	if (!push) goto fatal;
+	ndr_push_uint32(push, NDR_SCALARS, EMSMDB_PCMSPOLLMAX);
+	ndr_push_uint32(push, NDR_SCALARS, EMSMDB_PCRETRY);
+	ndr_push_uint32(push, NDR_SCALARS, EMSMDB_PCRETRYDELAY);
+	ndr_set_flags(&push->flags, LIBNDR_FLAG_STR_ASCII|LIBNDR_FLAG_STR_NULLTERM);
+	ndr_push_string(push, NDR_SCALARS, (retval == MAPI_E_SUCCESS && dnprefix) ? dnprefix : "");
+	push->flags &= ~LIBNDR_FLAG_STR_ASCII;
+	ndr_push_string(push, NDR_SCALARS, (retval == MAPI_E_SUCCESS && display_name) ? display_name : "");
+
+	if (retval != MAPI_E_SUCCESS) {
+		emsmdbp_mapihttp_respond_ndr(conn, push, NULL);
+		talloc_free(mem_ctx);
+		return;
+	}
+
+	session = talloc_zero(server, struct emsmdbp_mapihttp_session);
+	if (!session) {
+		emsmdb_mapihttp_disconnect(&cookie, NULL);
+		goto fatal;
+	}
+	session->cookie = cookie;
+	session->username = talloc_strdup(session, request->username);
+	session->used = time(NULL);
+	DLIST_ADD(server->sessions, session);
+
+	emsmdbp_mapihttp_respond_ndr(conn, push, &cookie);
+	talloc_free(mem_ctx);
+	return;
+
+fatal:
+	talloc_free(mem_ctx);
+	emsmdbp_mapihttp_respond(conn, "500 Internal Server Error", MAPIHTTP_UNKNOWN_FAILURE, NULL, NULL);
+}
+
+
+/**
+   \details Execute request type: process the ROP buffer
+ */
+static void emsmdbp_mapihttp_execute(struct emsmdbp_mapihttp_connection *conn,
+				     struct emsmdbp_mapihttp_session *session)
+{
+	struct emsmdbp_mapihttp_request	*request = conn->request;
+	struct ndr_pull			*pull;
+	struct ndr_push			*push;
+	enum MAPISTATUS			retval;
+	uint32_t			flags, size, max_out;
+	DATA_BLOB			rgbIn;
+	DATA_BLOB			rgbOut = data_blob_null;
+	TALLOC_CTX			*mem_ctx;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) goto fatal;
+
+	pull = ndr_pull_init_blob(&request->body, mem_ctx);
+	if (!pull) goto fatal;
+	ndr_set_flags(&pull->flags, LIBNDR_FLAG_NOALIGN);
+	if (ndr_pull_uint32(pull, NDR_SCALARS, &flags) != NDR_ERR_SUCCESS ||
+	    ndr_pull_uint32(pull, NDR_SCALARS, &size) != NDR_ERR_SUCCESS ||
+	    size > pull->data_size - pull->offset) {
+		goto invalid;
+	}
+	rgbIn.data = pull->data + pull->offset;
+	rgbIn.length = size;
+	pull->offset += size;
+	if (ndr_pull_uint32(pull, NDR_SCALARS, &max_out) != NDR_ERR_SUCCESS) {
+		goto invalid;
+	}
+
+	retval = emsmdb_mapihttp_execute(mem_ctx, &session->cookie, request->username, &rgbIn,
+					 flags, max_out, &rgbOut);
+	if (retval == MAPI_E_LOGON_FAILED) {
+		emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_CONTEXT_NOT_FOUND, NULL, NULL);
+		talloc_free(mem_ctx);
+		return;
+	}
+
+	push = emsmdbp_mapihttp_push_init(mem_ctx, 0, retval);
+	if (!push) goto fatal;
+	ndr_push_uint32(push, NDR_SCALARS, 0);
+	ndr_push_uint32(push, NDR_SCALARS, rgbOut.length);
+	ndr_push_bytes(push, rgbOut.data, rgbOut.length);
+	emsmdbp_mapihttp_respond_ndr(conn, push, NULL);
+	talloc_free(mem_ctx);
+	return;
+
+invalid:
+	talloc_free(mem_ctx);
+	emsmdbp_mapihttp_respond(conn, "400 Bad Request", MAPIHTTP_INVALID_REQUEST_BODY, NULL, NULL);
+	return;
+
+fatal:
+	talloc_free(mem_ctx);
+	emsmdbp_mapihttp_respond(conn, "500 Internal Server Error", MAPIHTTP_UNKNOWN_FAILURE, NULL, NULL);
+}
+
+
+/**
+   \details Answer a NotificationWait request once an event is
+   pending or the wait period is over
+ */
+static void emsmdbp_mapihttp_notification_wait(struct tevent_context *ev, struct tevent_timer *te,
+					       struct timeval current_time, void *private_data)
+{
+	struct emsmdbp_mapihttp_connection	*conn = (struct emsmdbp_mapihttp_connection *) private_data;
+	struct emsmdbp_mapihttp_session		*session;
+	struct GUID				uuid;
+	struct ndr_push				*push;
+	enum MAPISTATUS				retval;
+	bool					pending = false;
+
+	conn->wait_timer = NULL;
+
+	session = emsmdbp_mapihttp_session_find(conn->server, conn->request->cookie, &uuid);
+	if (!session) {
+		emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_CONTEXT_NOT_FOUND, NULL, NULL);
+		return;
+	}
+
+	retval = emsmdb_mapihttp_notification_pending(&session->cookie, conn->request->username, &pending);
+	if (retval != MAPI_E_SUCCESS) {
+		emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_CONTEXT_NOT_FOUND, NULL, NULL);
+		return;
+	}
+
+	if (!pending && time(NULL) < conn->wait_deadline) {
+		conn->wait_timer = tevent_add_timer(ev, conn, timeval_current_ofs(1, 0),
+						    emsmdbp_mapihttp_notification_wait, conn);
+		if (conn->wait_timer) return;
+	}
+
+	push = emsmdbp_mapihttp_push_init(conn, 0, MAPI_E_SUCCESS);
+	if (push) {
+		ndr_push_uint32(push, NDR_SCALARS, pending ? 1 : 0);
+	}
+	emsmdbp_mapihttp_respond_ndr(conn, push, NULL);
+}
+
+
+/**
+   \details Dispatch a complete request on its X-RequestType
+ */
+static void emsmdbp_mapihttp_dispatch(struct emsmdbp_mapihttp_connection *conn)
+{
+	struct emsmdbp_mapihttp		*server = conn->server;
+	struct emsmdbp_mapihttp_request	*request = conn->request;
+	struct emsmdbp_mapihttp_session	*session;
+	struct GUID			uuid;
+	struct ndr_push			*push;
+
+	conn->keep_alive = request->keep_alive;
+
+	if (strcmp(request->method, "POST")) {
+		emsmdbp_mapihttp_respond(conn, "405 Method Not Allowed", MAPIHTTP_INVALID_VERB, NULL, NULL);
+		return;
+	}
+	if (strncasecmp(request->path, "/mapi/emsmdb", 12)) {
+		emsmdbp_mapihttp_respond(conn, "404 Not Found", MAPIHTTP_INVALID_PATH, NULL, NULL);
+		return;
+	}
+	if (!request->username || !request->username[0]) {
+		emsmdbp_mapihttp_respond(conn, "401 Unauthorized", MAPIHTTP_ANONYMOUS_NOT_ALLOWED, NULL, NULL);
+		return;
+	}
+	if (!request->request_type) {
+		emsmdbp_mapihttp_respond(conn, "400 Bad Request", MAPIHTTP_INVALID_REQUEST_TYPE, NULL, NULL);
+		return;
+	}
+
+	if (!strcasecmp(request->request_type, "PING")) {
+		emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_SUCCESS, NULL, NULL);
+		return;
+	}
+	if (!strcasecmp(request->request_type, "Connect")) {
+		emsmdbp_mapihttp_connect(conn);
+		return;
+	}
+
+	/* Other request types need the session cookie */
+	if (!request->cookie) {
+		emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_MISSING_COOKIE, NULL, NULL);
+		return;
+	}
+	session = emsmdbp_mapihttp_session_find(server, request->cookie, &uuid);
+	if (!session || strcasecmp(session->username, request->username)) {
+		emsmdbp_mapihttp_respond(conn, "200 OK", MAPIHTTP_CONTEXT_NOT_FOUND, NULL, NULL);
+		return;
+	}
+
+	if (!strcasecmp(request->request_type, "Execute")) {
+		emsmdbp_mapihttp_execute(conn, session);
+	} else if (!strcasecmp(request->request_type, "Disconnect")) {
+		OC_DEBUG(3, "[mapihttp]: Disconnect of %s", session->username);
+		emsmdbp_mapihttp_session_release(server, session);
+		push = emsmdbp_mapihttp_push_init(conn, 0, MAPI_E_SUCCESS);
+		emsmdbp_mapihttp_respond_ndr(conn, push, NULL);
+	} else if (!strcasecmp(request->request_type, "NotificationWait")) {
+		/* Answered as soon as an event is pending */
+		conn->wait_deadline = time(NULL) + server->notification_wait;
+		emsmdbp_mapihttp_notification_wait(server->ev, NULL, timeval_current(), conn);
+	} else {
+		emsmdbp_mapihttp_respond(conn, "400 Bad Request", MAPIHTTP_INVALID_REQUEST_TYPE, NULL, NULL);
+	}
+}
+
+
+/**
+   \details Parse the request line and the headers the endpoint uses
+
+   \return true on success, otherwise false
+ */
+static bool emsmdbp_mapihttp_parse_headers(struct emsmdbp_mapihttp_connection *conn)
+{
+	struct emsmdbp_mapihttp_request	*request;
+	char				*headers;
+	char				*line;
+	char				*saveptr = NULL;
+	char				*value;
+	char				*end;
+	size_t				user_header_len;
+
+	request = talloc_zero(conn, struct emsmdbp_mapihttp_request);
+	if (!request) return false;
+	conn->request = request;
+	request->keep_alive = true;
+
+	headers = talloc_strndup(request, (const char *) conn->in.data, conn->headers_length);
+	if (!headers) return false;
+
+	/* Request line */
+	line = strtok_r(headers, "\r\n", &saveptr);
+	if (!line) return false;
+	request->method = line;
+	request->path = strchr(line, ' ');
+	if (!request->path) return false;
+	*request->path++ = '\0';
+	end = strchr(request->path, ' ');
+	if (!end) return false;
+	*end++ = '\0';
+	if (!strcmp(end, "HTTP/1.0")) {
+		request->keep_alive = false;
+	}
+
+	user_header_len = strlen(conn->server->user_header);
+	while ((line = strtok_r(NULL, "\r\n", &saveptr)) != NULL) {
+		value = strchr(line, ':');
+		if (!value) continue;
+		*value++ = '\0';
+		while (*value == ' ' || *value == '\t') value++;
+
+		if (!strcasecmp(line, "Content-Length")) {
+			request->content_length = strtoul(value, NULL, 10);
+		} else if (!strcasecmp(line, "X-RequestType")) {
+			request->request_type = value;
+		} else if (!strcasecmp(line, "X-RequestId")) {
+			request->request_id = value;
+		} else if (!strcasecmp(line, "X-ClientInfo")) {
+			request->client_info = value;
+		} else if (!strcasecmp(line, "Connection")) {
+			request->keep_alive = strcasecmp(value, "close") != 0;
+		} else if (!strcasecmp(line, "Cookie")) {
+			value = strstr(value, "MapiContext=");
+			if (value) {
+				request->cookie = value + strlen("MapiContext=");
+				end = strchr(request->cookie, ';');
+				if (end) *end = '\0';
+			}
+		} else if (strlen(line) == user_header_len && !strcasecmp(line, conn->server->user_header)) {
+			/* DOMAIN\user and user@realm are reduced to the account name */
+			end = strchr(value, '\\');
+			if (end) value = end + 1;
+			end = strchr(value, '@');
+			if (end) *end = '\0';
+			request->username = value;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+   \details Return the worker the sessions of a user live in
+ */
+static int emsmdbp_mapihttp_owner(struct emsmdbp_mapihttp *server, const char *username)
+{
+	uint32_t	hash = 2166136261U;
+
+	/* FNV-1a, account names are case insensitive */
+	for (; *username; username++) {
+		hash = (hash ^ (uint8_t) tolower((unsigned char) *username)) * 16777619U;
+	}
+
+	return hash % server->workers;
+}
+
+
+/**
+   \details Pass a connection to another worker, together with the
+   bytes read so far
+
+   \return true on success, otherwise false
+ */
+static bool emsmdbp_mapihttp_route(struct emsmdbp_mapihttp_connection *conn, int worker)
+{
+	struct msghdr	msg;
+	struct cmsghdr	*cmsg;
+	struct iovec	iov;
+	char		control[CMSG_SPACE(sizeof (int))];
+
+	memset(&msg, 0, sizeof (msg));
+	memset(control, 0, sizeof (control));
+	iov.iov_base = conn->in.data;
+	iov.iov_len = conn->in.length;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof (control);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof (int));
+	memcpy(CMSG_DATA(cmsg), &conn->fd, sizeof (int));
+
+	if (sendmsg(conn->server->channels[worker], &msg, MSG_DONTWAIT) == -1) {
+		OC_DEBUG(1, "[mapihttp]: unable to pass the connection of %s to worker %d: %s",
+			 conn->request->username, worker, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+   \details Process the bytes read on a connection, dispatch the
+   request once complete
+ */
+static void emsmdbp_mapihttp_process(struct emsmdbp_mapihttp_connection *conn)
+{
+	struct emsmdbp_mapihttp	*server = conn->server;
+	size_t			total;
+	void			*end;
+	int			worker;
+
+	/* Wait for the end of the headers */
+	if (!conn->headers_length) {
+		end = memmem(conn->in.data, conn->in.length, "\r\n\r\n", 4);
+		if (!end) {
+			if (conn->in.length > EMSMDBP_MAPIHTTP_MAX_HEADERS) {
+				talloc_free(conn);
+			}
+			return;
+		}
+		conn->headers_length = (uint8_t *) end - conn->in.data;
+		conn->started = timeval_current();
+		if (!emsmdbp_mapihttp_parse_headers(conn)) {
+			conn->keep_alive = false;
+			emsmdbp_mapihttp_respond(conn, "400 Bad Request", MAPIHTTP_UNKNOWN_FAILURE, NULL, NULL);
+			return;
+		}
+		if (conn->request->content_length > EMSMDBP_MAPIHTTP_MAX_REQUEST) {
+			conn->keep_alive = false;
+			emsmdbp_mapihttp_respond(conn, "413 Request Entity Too Large", MAPIHTTP_TOO_LARGE, NULL, NULL);
+			return;
+		}
+
+		/* Served by the worker the sessions of the user live in */
+		if (server->workers > 1 && conn->request->username) {
+			worker = emsmdbp_mapihttp_owner(server, conn->request->username);
+			if (worker != server->worker) {
+				if (emsmdbp_mapihttp_route(conn, worker)) {
+					talloc_free(conn);
+				} else {
+					conn->keep_alive = false;
+					emsmdbp_mapihttp_respond(conn, "503 Service Unavailable",
+								 MAPIHTTP_UNKNOWN_FAILURE, NULL, NULL);
+				}
+				return;
+			}
+		}
+	}
+
+	/* Wait for the body */
+	total = conn->headers_length + 4 + conn->request->content_length;
+	if (conn->in.length < total) return;
+
+	conn->request->body.data = conn->in.data + conn->headers_length + 4;
+	conn->request->body.length = conn->request->content_length;
+	emsmdbp_mapihttp_dispatch(conn);
+}
+
+
+/**
+   \details Read request bytes
+ */
+static void emsmdbp_mapihttp_read(struct emsmdbp_mapihttp_connection *conn)
+{
+	uint8_t		buffer[EMSMDBP_MAPIHTTP_READ_SIZE];
+	uint8_t		*data;
+	ssize_t		len;
+
+	len = read(conn->fd, buffer, sizeof (buffer));
+	if (len == -1 && (errno == EAGAIN || errno == EINTR)) return;
+	if (len <= 0) {
+		talloc_free(conn);
+		return;
+	}
+
+	data = talloc_realloc(conn, conn->in.data, uint8_t, conn->in.length + len);
+	if (!data) {
+		talloc_free(conn);
+		return;
+	}
+	memcpy(data + conn->in.length, buffer, len);
+	conn->in.data = data;
+	conn->in.length += len;
+
+	emsmdbp_mapihttp_process(conn);
+}
+
+
+/**
+   \details Write the pending response, then wait for the next request
+ */
+static void emsmdbp_mapihttp_write(struct emsmdbp_mapihttp_connection *conn)
+{
+	ssize_t		len;
+
+	if (!conn->out.length) {
+		talloc_free(conn);
+		return;
+	}
+
+	len = write(conn->fd, conn->out.data + conn->sent, conn->out.length - conn->sent);
+	if (len == -1 && (errno == EAGAIN || errno == EINTR)) return;
+	if (len <= 0) {
+		talloc_free(conn);
+		return;
+	}
+
+	conn->sent += len;
+	if (conn->sent < conn->out.length) return;
+
+	if (!conn->keep_alive) {
+		talloc_free(conn);
+		return;
+	}
+
+	/* Ready for the next request of the connection */
+	TALLOC_FREE(conn->request);
+	TALLOC_FREE(conn->in.data);
+	TALLOC_FREE(conn->out.data);
+	conn->in.length = 0;
+	conn->out.length = 0;
+	conn->headers_length = 0;
+	conn->sent = 0;
+	TEVENT_FD_NOT_WRITEABLE(conn->fde);
+	TEVENT_FD_READABLE(conn->fde);
+}
+
+static void emsmdbp_mapihttp_connection_handler(struct tevent_context *ev, struct tevent_fd *fde,
+						uint16_t flags, void *private_data)
+{
+	struct emsmdbp_mapihttp_connection	*conn = (struct emsmdbp_mapihttp_connection *) private_data;
+
+	if (flags & TEVENT_FD_WRITE) {
+		emsmdbp_mapihttp_write(conn);
+	} else if (flags & TEVENT_FD_READ) {
+		/* A NotificationWait client closing its connection */
+		if (conn->wait_timer) {
+			talloc_free(conn);
+			return;
+		}
+		emsmdbp_mapihttp_read(conn);
+	}
+}
+
+
+static struct emsmdbp_mapihttp_connection *emsmdbp_mapihttp_connection_new(struct emsmdbp_mapihttp *server, int fd)
+{
+	struct emsmdbp_mapihttp_connection	*conn;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	conn = talloc_zero(server, struct emsmdbp_mapihttp_connection);
+	if (!conn) {
+		close(fd);
+		return NULL;
+	}
+	conn->server = server;
+	conn->fd = fd;
+	DLIST_ADD(server->connections, conn);
+	talloc_set_destructor(conn, emsmdbp_mapihttp_connection_destructor);
+
+	conn->fde = tevent_add_fd(server->ev, conn, fd, TEVENT_FD_READ, emsmdbp_mapihttp_connection_handler, conn);
+	if (!conn->fde) {
+		talloc_free(conn);
+		return NULL;
+	}
+
+	return conn;
+}
+
+static void emsmdbp_mapihttp_accept(struct tevent_context *ev, struct tevent_fd *fde,
+				    uint16_t flags, void *private_data)
+{
+	struct emsmdbp_mapihttp			*server = (struct emsmdbp_mapihttp *) private_data;
+	int					fd;
+
+	/* The other workers may have accepted it first */
+	fd = accept(server->fd, NULL, NULL);
+	if (fd == -1) return;
+
+	emsmdbp_mapihttp_connection_new(server, fd);
+}
+
+
+/**
+   \details Take over a connection passed by another worker
+ */
+static void emsmdbp_mapihttp_receive(struct tevent_context *ev, struct tevent_fd *fde,
+				     uint16_t flags, void *private_data)
+{
+	struct emsmdbp_mapihttp			*server = (struct emsmdbp_mapihttp *) private_data;
+	struct emsmdbp_mapihttp_connection	*conn;
+	struct msghdr				msg;
+	struct cmsghdr				*cmsg;
+	struct iovec				iov;
+	char					control[CMSG_SPACE(sizeof (int))];
+	uint8_t					*buffer;
+	ssize_t					len;
+	int					fd = -1;
+
+	buffer = talloc_array(server, uint8_t, EMSMDBP_MAPIHTTP_MAX_HEADERS + EMSMDBP_MAPIHTTP_READ_SIZE);
+	if (!buffer) return;
+
+	memset(&msg, 0, sizeof (msg));
+	iov.iov_base = buffer;
+	iov.iov_len = EMSMDBP_MAPIHTTP_MAX_HEADERS + EMSMDBP_MAPIHTTP_READ_SIZE;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof (control);
+
+	len = recvmsg(server->channel, &msg, MSG_DONTWAIT);
+	if (len == -1) {
+		talloc_free(buffer);
+		return;
+	}
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+			memcpy(&fd, CMSG_DATA(cmsg), sizeof (int));
+		}
+	}
+	if (fd == -1 || len == 0 || (msg.msg_flags & (MSG_TRUNC|MSG_CTRUNC))) {
+		if (fd != -1) close(fd);
+		talloc_free(buffer);
+		return;
+	}
+
+	conn = emsmdbp_mapihttp_connection_new(server, fd);
+	if (!conn) {
+		talloc_free(buffer);
+		return;
+	}
+	conn->in.data = talloc_steal(conn, buffer);
+	conn->in.length = len;
+
+	emsmdbp_mapihttp_process(conn);
+}
+
+
+/**
+   \details Bind the listening socket on emsmdb:mapihttp_listen
+
+   \return the socket on success, otherwise -1
+ */
+static int emsmdbp_mapihttp_listen(TALLOC_CTX *mem_ctx, const char *listen_addr)
+{
+	struct addrinfo		hints;
+	struct addrinfo		*res = NULL;
+	char			*addr;
+	char			*host;
+	char			*port;
+	int			fd = -1;
+	int			on = 1;
+
+	addr = talloc_strdup(mem_ctx, listen_addr);
+	if (!addr) return -1;
+	host = addr;
+	port = strrchr(host, ':');
+	if (!port) {
+		OC_DEBUG(0, "[mapihttp]: invalid emsmdb:mapihttp_listen '%s', expected address:port", listen_addr);
+		talloc_free(addr);
+		return -1;
+	}
+	*port++ = '\0';
+	if (host[0] == '[') {
+		host++;
+		host[strlen(host) - 1] = '\0';
+	}
+
+	memset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	if (getaddrinfo(host, port, &hints, &res) || !res) {
+		OC_DEBUG(0, "[mapihttp]: unable to resolve '%s'", listen_addr);
+		goto end;
+	}
+
+	fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd == -1) goto end;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on));
+	if (bind(fd, res->ai_addr, res->ai_addrlen) == -1 || listen(fd, 64) == -1) {
+		OC_DEBUG(0, "[mapihttp]: unable to listen on '%s': %s", listen_addr, strerror(errno));
+		close(fd);
+		fd = -1;
+		goto end;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+end:
+	if (res) freeaddrinfo(res);
+	talloc_free(addr);
+	return fd;
+}
+
+
+/**
+   \details Run the MAPI/HTTP endpoint, never returns
+ */
+static void emsmdbp_mapihttp_run(struct loadparm_context *lp_ctx, int fd, int worker,
+				 int workers, int channel, int *channels)
+{
+	struct emsmdbp_mapihttp	*server;
+
+	server = talloc_zero(NULL, struct emsmdbp_mapihttp);
+	if (!server) _exit(1);
+	server->lp_ctx = lp_ctx;
+	server->fd = fd;
+	server->worker = worker;
+	server->workers = workers;
+	server->channel = channel;
+	server->channels = channels;
+	server->user_header = lpcfg_parm_string(lp_ctx, NULL, "emsmdb", "mapihttp_user_header");
+	if (!server->user_header) {
+		server->user_header = EMSMDBP_MAPIHTTP_USER_HEADER;
+	}
+	server->session_timeout = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "mapihttp_session_timeout",
+						 EMSMDBP_MAPIHTTP_SESSION_TIMEOUT);
+	server->notification_wait = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "mapihttp_notification_wait",
+						   EMSMDBP_MAPIHTTP_NOTIFICATION_WAIT);
+	server->server_id.pid = getpid();
+
+	server->ev = tevent_context_init(server);
+	if (!server->ev) _exit(1);
+
+	if (!emsmdb_mapihttp_init(lp_ctx)) {
+		OC_DEBUG(0, "[mapihttp]: Unable to initialize openchangedb");
+		_exit(1);
+	}
+
+	if (!tevent_add_fd(server->ev, server, fd, TEVENT_FD_READ, emsmdbp_mapihttp_accept, server) ||
+	    !tevent_add_timer(server->ev, server, timeval_current_ofs(60, 0), emsmdbp_mapihttp_expire, server)) {
+		_exit(1);
+	}
+	if (workers > 1 &&
+	    !tevent_add_fd(server->ev, server, channel, TEVENT_FD_READ, emsmdbp_mapihttp_receive, server)) {
+		_exit(1);
+	}
+
+	tevent_loop_wait(server->ev);
+	_exit(0);
+}
+
+
+/**
+   \details Start the MAPI/HTTP endpoint in emsmdb:mapihttp_workers
+   processes of its own
+
+   \param lp_ctx pointer to the loadparm context
+
+   \return true on success, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_mapihttp_start(struct loadparm_context *lp_ctx)
+{
+	const char	*listen_addr;
+	int		fd;
+	int		workers;
+	int		channels[EMSMDBP_MAPIHTTP_MAX_WORKERS];
+	int		receivers[EMSMDBP_MAPIHTTP_MAX_WORKERS];
+	int		pair[2];
+	int		i, j;
+	pid_t		pid;
+
+	listen_addr = lpcfg_parm_string(lp_ctx, NULL, "emsmdb", "mapihttp_listen");
+	if (!listen_addr) {
+		listen_addr = EMSMDBP_MAPIHTTP_LISTEN;
+	}
+	workers = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "mapihttp_workers", 1);
+	workers = MAX(1, MIN(workers, EMSMDBP_MAPIHTTP_MAX_WORKERS));
+
+	/* Bind in the parent so that a busy port is reported at startup */
+	fd = emsmdbp_mapihttp_listen(NULL, listen_addr);
+	if (fd == -1) return false;
+
+	/* Each worker reads the connections passed to it on its end of a
+	 * socket pair, the other end is shared by all workers */
+	for (i = 0; i < workers; i++) {
+		channels[i] = receivers[i] = -1;
+		if (workers == 1) continue;
+		if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pair) == -1) {
+			OC_DEBUG(0, "[mapihttp]: socketpair failed: %s", strerror(errno));
+			workers = i;
+			break;
+		}
+		channels[i] = pair[0];
+		receivers[i] = pair[1];
+		fcntl(receivers[i], F_SETFL, fcntl(receivers[i], F_GETFL) | O_NONBLOCK);
+	}
+
+	for (i = 0; i < workers; i++) {
+		pid = fork();
+		if (pid == -1) {
+			OC_DEBUG(0, "[mapihttp]: fork failed: %s", strerror(errno));
+			break;
+		}
+		if (pid == 0) {
+			signal(SIGPIPE, SIG_IGN);
+			for (j = 0; j < workers; j++) {
+				if (j != i && receivers[j] != -1) close(receivers[j]);
+			}
+			emsmdbp_mapihttp_run(lp_ctx, fd, i, workers, receivers[i], channels);
+		}
+		OC_DEBUG(1, "[mapihttp]: MAPI/HTTP worker %d listening on %s (pid %d)", i, listen_addr, (int) pid);
+	}
+	close(fd);
+	for (j = 0; j < workers; j++) {
+		if (channels[j] != -1) close(channels[j]);
+		if (receivers[j] != -1) close(receivers[j]);
+	}
+
+	return i > 0;
+}
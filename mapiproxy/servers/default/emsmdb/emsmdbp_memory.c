@@ -0,0 +1,182 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_memory.c
+
+   \brief Per-session memory accounting and limits
+
+   Everything a session keeps between calls hangs from the talloc tree
+   of its emsmdbp context: open objects, tables, fast transfer and
+   stream buffers. The size of that tree is sampled at the beginning of
+   the calls, at most once every emsmdb:session_memory_sample_interval
+   seconds, and published in the statistics file of the worker when
+   emsmdb:rop_stats is enabled.
+
+   Past emsmdb:session_memory_soft_limit, FastTransferSourceGetBuffer
+   and ReadStream return smaller buffers and new streams spill to disk
+   early. Past emsmdb:session_memory_hard_limit, the session caches are
+   dropped and every ROP but Release is answered with ecServerOOM, so
+   the client releases its objects instead of the worker, and every
+   other session it hosts, getting killed.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Buffers returned past the soft limit */
+#define	EMSMDBP_MEMORY_SOFT_BUFFER_SIZE	0x2000
+
+static bool	emsmdbp_memory_initialized = false;
+static size_t	emsmdbp_memory_soft_limit = 0;
+static size_t	emsmdbp_memory_hard_limit = 0;
+static int	emsmdbp_memory_interval = 1;
+
+static void emsmdbp_memory_init(struct loadparm_context *lp_ctx)
+{
+	int	limit;
+
+	if (emsmdbp_memory_initialized) return;
+	emsmdbp_memory_initialized = true;
+
+	limit = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "session_memory_soft_limit", 0);
+	emsmdbp_memory_soft_limit = (limit > 0) ? (size_t) limit * 1024 * 1024 : 0;
+
+	limit = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "session_memory_hard_limit", 0);
+	emsmdbp_memory_hard_limit = (limit > 0) ? (size_t) limit * 1024 * 1024 : 0;
+
+	emsmdbp_memory_interval = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "session_memory_sample_interval", 1);
+	if (emsmdbp_memory_interval < 0) {
+		emsmdbp_memory_interval = 0;
+	}
+}
+
+
+/**
+   \details Drop what the session only keeps to go faster
+ */
+static void emsmdbp_memory_shed(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_propset	*propset;
+
+	while ((propset = emsmdbp_ctx->propsets)) {
+		DLIST_REMOVE(emsmdbp_ctx->propsets, propset);
+		talloc_free(propset);
+	}
+}
+
+
+/**
+   \details Sample the memory used by a session and return its state
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+
+   \return the memory state of the session
+ */
+_PUBLIC_ enum emsmdbp_memory_state emsmdbp_memory_sample(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_memory		*memory;
+	enum emsmdbp_memory_state	state;
+	time_t				now;
+
+	if (!emsmdbp_ctx) return EMSMDBP_MEMORY_NORMAL;
+
+	emsmdbp_memory_init(emsmdbp_ctx->lp_ctx);
+	memory = &emsmdbp_ctx->memory;
+
+	/* Walking the tree is only worth it when someone looks */
+	if (!emsmdbp_memory_soft_limit && !emsmdbp_memory_hard_limit && !emsmdbp_stats_enabled()) {
+		return EMSMDBP_MEMORY_NORMAL;
+	}
+
+	now = time(NULL);
+	if (memory->sampled && now - memory->sampled < emsmdbp_memory_interval) {
+		return memory->state;
+	}
+	memory->sampled = now;
+
+	memory->size = talloc_total_size(emsmdbp_ctx->mem_ctx);
+	if (memory->size > memory->peak) {
+		memory->peak = memory->size;
+	}
+
+	state = EMSMDBP_MEMORY_NORMAL;
+	if (emsmdbp_memory_hard_limit && memory->size >= emsmdbp_memory_hard_limit) {
+		state = EMSMDBP_MEMORY_HARD;
+	} else if (emsmdbp_memory_soft_limit && memory->size >= emsmdbp_memory_soft_limit) {
+		state = EMSMDBP_MEMORY_SOFT;
+	}
+
+	if (state != memory->state) {
+		OC_DEBUG(state == EMSMDBP_MEMORY_NORMAL ? 3 : 1, "session of %s uses %zu bytes, memory state %d -> %d",
+			 emsmdbp_ctx->username, memory->size, memory->state, state);
+		if (state == EMSMDBP_MEMORY_HARD) {
+			emsmdbp_memory_shed(emsmdbp_ctx);
+		}
+		memory->state = state;
+	}
+
+	if (!memory->stats) {
+		memory->stats = emsmdbp_stats_session_get(emsmdbp_ctx->username);
+	}
+	if (memory->stats) {
+		memory->stats->state = memory->state;
+		memory->stats->size = memory->size;
+		memory->stats->peak = memory->peak;
+	}
+
+	return memory->state;
+}
+
+
+/**
+   \details Return the size of a buffer the session may be given
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param size the size requested
+
+   \return size, or a smaller value when the session is past its soft
+   limit
+ */
+_PUBLIC_ uint32_t emsmdbp_memory_buffer_size(struct emsmdbp_context *emsmdbp_ctx, uint32_t size)
+{
+	if (!emsmdbp_ctx || emsmdbp_ctx->memory.state == EMSMDBP_MEMORY_NORMAL) {
+		return size;
+	}
+
+	return (size > EMSMDBP_MEMORY_SOFT_BUFFER_SIZE) ? EMSMDBP_MEMORY_SOFT_BUFFER_SIZE : size;
+}
+
+
+/**
+   \details Release the memory gauge of a session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_memory_release(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx) return;
+
+	emsmdbp_stats_session_release(emsmdbp_ctx->memory.stats);
+	emsmdbp_ctx->memory.stats = NULL;
+}
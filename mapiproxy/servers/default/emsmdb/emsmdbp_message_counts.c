@@ -0,0 +1,325 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_message_counts.c
+
+   \brief Message counters of the mapistore folders
+
+   The number of messages, FAI messages and unread messages of a
+   folder, and the sum of their sizes, are requested by clients at
+   logon and each time they refresh their folder list. When
+   emsmdb:message_counts_ttl is set, they are counted once from the
+   contents table of the folder and stored in openchangedb. The
+   changes made through this server update the stored counters:
+
+   - a saved message adds its contribution to its folder, less the one
+     it had when it was opened;
+   - a read flag change moves the unread counter.
+
+   Operations on many messages at once (deletions, moves, copies and
+   read flags changed as a set) forget the counters of the folders
+   involved, which are counted again on the next lookup. So does new
+   mail. Other changes made straight to the backend are only seen once
+   the counters are older than emsmdb:message_counts_ttl seconds.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Number of rows read at once when counting the messages of a folder */
+#define	EMSMDBP_MESSAGE_COUNTS_BATCH	256
+
+static uint32_t emsmdbp_message_counts_ttl(struct emsmdbp_context *emsmdbp_ctx)
+{
+	int	ttl;
+
+	ttl = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "message_counts_ttl", 0);
+
+	return (ttl > 0) ? ttl : 0;
+}
+
+
+static void emsmdbp_message_counts_add(struct openchangedb_message_counts *counts, uint32_t flags, uint32_t size)
+{
+	if (flags & MSGFLAG_ASSOCIATED) {
+		counts->fai++;
+	} else {
+		counts->messages++;
+		if (!(flags & MSGFLAG_READ)) {
+			counts->unread++;
+		}
+	}
+	counts->size += size;
+}
+
+
+/**
+   \details Count the messages of a folder from its contents table
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object the mapistore folder
+   \param counts pointer to the counters to fill
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_message_counts_scan(struct emsmdbp_context *emsmdbp_ctx,
+						   struct emsmdbp_object *folder_object,
+						   struct openchangedb_message_counts *counts)
+{
+	struct mapistore_property_data	**rows;
+	enum mapistore_error		ret;
+	enum MAPITAGS			columns[2] = { PidTagMessageFlags, PidTagMessageSize };
+	TALLOC_CTX			*mem_ctx, *batch_ctx;
+	void				*table;
+	uint32_t			contextID, fai_count = 0, row_count = 0;
+	uint32_t			start, count, fetched, j;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	memset(counts, 0, sizeof (struct openchangedb_message_counts));
+	contextID = emsmdbp_get_contextID(folder_object);
+
+	/* FAI messages are only counted, their size is left out */
+	ret = mapistore_folder_get_child_count(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object,
+					       MAPISTORE_FAI_TABLE, &fai_count);
+	OPENCHANGE_RETVAL_IF(ret != MAPISTORE_SUCCESS, mapistore_error_to_mapi(ret), mem_ctx);
+	counts->fai = fai_count;
+
+	ret = mapistore_folder_open_table(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object, mem_ctx,
+					  MAPISTORE_MESSAGE_TABLE, 0, &table, &row_count);
+	OPENCHANGE_RETVAL_IF(ret != MAPISTORE_SUCCESS, mapistore_error_to_mapi(ret), mem_ctx);
+	ret = mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, contextID, table, 2, columns);
+	OPENCHANGE_RETVAL_IF(ret != MAPISTORE_SUCCESS, mapistore_error_to_mapi(ret), mem_ctx);
+
+	for (start = 0; start < row_count; start += fetched) {
+		count = row_count - start;
+		if (count > EMSMDBP_MESSAGE_COUNTS_BATCH) {
+			count = EMSMDBP_MESSAGE_COUNTS_BATCH;
+		}
+		batch_ctx = talloc_new(mem_ctx);
+		ret = mapistore_table_get_rows(emsmdbp_ctx->mstore_ctx, contextID, table, batch_ctx,
+					       MAPISTORE_PREFILTERED_QUERY, start, count, &rows, &fetched);
+		if (ret == MAPISTORE_SUCCESS && !fetched) {
+			ret = MAPISTORE_ERR_NOT_FOUND;
+		}
+		/* Counters missing some rows are not worth storing */
+		OPENCHANGE_RETVAL_IF(ret != MAPISTORE_SUCCESS, mapistore_error_to_mapi(ret), mem_ctx);
+
+		for (j = 0; j < fetched; j++) {
+			emsmdbp_message_counts_add(counts,
+				   (rows[j][0].error == MAPISTORE_SUCCESS) ? *(uint32_t *)rows[j][0].data : 0,
+				   (rows[j][1].error == MAPISTORE_SUCCESS) ? *(uint32_t *)rows[j][1].data : 0);
+		}
+		talloc_free(batch_ctx);
+	}
+
+	talloc_free(mem_ctx);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the message counters of a mapistore folder
+
+   The counters stored in openchangedb are used when they are recent
+   enough, otherwise the contents of the folder are counted and
+   stored.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object the mapistore folder
+   \param counts pointer to the counters to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT if the
+   counters are not maintained, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_message_counts_get_folder(struct emsmdbp_context *emsmdbp_ctx,
+							   struct emsmdbp_object *folder_object,
+							   struct openchangedb_message_counts *counts)
+{
+	enum MAPISTATUS	retval;
+	uint32_t	ttl;
+	uint64_t	fid;
+	char		*owner;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!counts, MAPI_E_INVALID_PARAMETER, NULL);
+
+	ttl = emsmdbp_message_counts_ttl(emsmdbp_ctx);
+	OPENCHANGE_RETVAL_IF(!ttl || !emsmdbp_is_mapistore(folder_object), MAPI_E_NO_SUPPORT, NULL);
+
+	owner = emsmdbp_get_owner(folder_object);
+	fid = folder_object->object.folder->folderID;
+	if (openchangedb_get_message_counts(emsmdbp_ctx->oc_ctx, owner, fid, ttl, counts) == MAPI_E_SUCCESS) {
+		return MAPI_E_SUCCESS;
+	}
+
+	retval = emsmdbp_message_counts_scan(emsmdbp_ctx, folder_object, counts);
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
+
+	openchangedb_set_message_counts(emsmdbp_ctx->oc_ctx, owner, fid, counts);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Remember the contribution of a message to the counters of
+   its folder, before the message is changed
+
+   A message being created does not count yet. The contribution of an
+   existing message is read from its backend, unless it is already
+   known.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object the mapistore message
+   \param created whether the message is being created
+ */
+_PUBLIC_ void emsmdbp_message_counts_track(struct emsmdbp_context *emsmdbp_ctx,
+					   struct emsmdbp_object *message_object,
+					   bool created)
+{
+	struct openchangedb_message_counts	*counts;
+	struct mapistore_property_data		props[2];
+	enum MAPITAGS				proptags[2] = { PidTagMessageFlags, PidTagMessageSize };
+	enum mapistore_error			ret;
+
+	if (!emsmdbp_ctx || !message_object || message_object->type != EMSMDBP_OBJECT_MESSAGE) return;
+	if (message_object->object.message->counts) return;
+	if (!emsmdbp_message_counts_ttl(emsmdbp_ctx) || !emsmdbp_is_mapistore(message_object)) return;
+
+	counts = talloc_zero(message_object->object.message, struct openchangedb_message_counts);
+	if (!counts) return;
+
+	if (!created) {
+		ret = mapistore_properties_get_properties(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(message_object),
+							  message_object->backend_object, counts, 2, proptags, props);
+		if (ret != MAPISTORE_SUCCESS || props[0].error != MAPISTORE_SUCCESS) {
+			talloc_free(counts);
+			return;
+		}
+		emsmdbp_message_counts_add(counts, *(uint32_t *)props[0].data,
+					   (props[1].error == MAPISTORE_SUCCESS) ? *(uint32_t *)props[1].data : 0);
+	}
+
+	message_object->object.message->counts = counts;
+}
+
+
+/**
+   \details Forget the counters of a folder whose contents changed in a
+   way that is not followed message per message
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object the folder
+ */
+_PUBLIC_ void emsmdbp_message_counts_folder_changed(struct emsmdbp_context *emsmdbp_ctx,
+						    struct emsmdbp_object *folder_object)
+{
+	uint64_t	fid;
+
+	if (!emsmdbp_ctx || !folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+	if (!emsmdbp_message_counts_ttl(emsmdbp_ctx) || !emsmdbp_is_mapistore(folder_object)) return;
+
+	fid = folder_object->object.folder->folderID;
+	openchangedb_clear_message_counts(emsmdbp_ctx->oc_ctx, emsmdbp_get_owner(folder_object), 1, &fid);
+}
+
+
+/**
+   \details Update the counters of the folder of a message after it was
+   saved or its read flag changed
+
+   The difference with the contribution remembered by
+   emsmdbp_message_counts_track() is applied to the folder. The
+   counters of the folder are forgotten when that contribution is not
+   known.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object the mapistore message
+ */
+_PUBLIC_ void emsmdbp_message_counts_message_changed(struct emsmdbp_context *emsmdbp_ctx,
+						     struct emsmdbp_object *message_object)
+{
+	struct openchangedb_message_counts	*before;
+	struct openchangedb_message_counts	delta;
+	struct emsmdbp_object			*folder_object;
+
+	if (!emsmdbp_ctx || !message_object || message_object->type != EMSMDBP_OBJECT_MESSAGE) return;
+	folder_object = message_object->parent_object;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+	if (!emsmdbp_message_counts_ttl(emsmdbp_ctx) || !emsmdbp_is_mapistore(message_object)) return;
+
+	before = message_object->object.message->counts;
+	message_object->object.message->counts = NULL;
+	if (!before) {
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, folder_object);
+		return;
+	}
+
+	emsmdbp_message_counts_track(emsmdbp_ctx, message_object, false);
+	if (!message_object->object.message->counts) {
+		talloc_free(before);
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, folder_object);
+		return;
+	}
+
+	delta.messages = message_object->object.message->counts->messages - before->messages;
+	delta.fai = message_object->object.message->counts->fai - before->fai;
+	delta.unread = message_object->object.message->counts->unread - before->unread;
+	delta.size = message_object->object.message->counts->size - before->size;
+	talloc_free(before);
+
+	if (!delta.messages && !delta.fai && !delta.unread && !delta.size) return;
+
+	if (openchangedb_update_message_counts(emsmdbp_ctx->oc_ctx, emsmdbp_get_owner(folder_object),
+					       folder_object->object.folder->folderID, &delta) != MAPI_E_SUCCESS) {
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, folder_object);
+	}
+}
+
+
+/**
+   \details Forget the counters of the folders receiving new mail
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param notify the notification received
+ */
+_PUBLIC_ void emsmdbp_message_counts_notify(struct emsmdbp_context *emsmdbp_ctx, const struct Notify_repl *notify)
+{
+	uint64_t	fid;
+
+	if (!emsmdbp_ctx || !notify || !emsmdbp_message_counts_ttl(emsmdbp_ctx)) return;
+
+	switch (notify->NotificationType) {
+	case 0x0002: /* new mail */
+	case 0x8002:
+		fid = notify->NotificationData.NewMailNotification.FID;
+		openchangedb_clear_message_counts(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, 1, &fid);
+		break;
+	default:
+		break;
+	}
+}
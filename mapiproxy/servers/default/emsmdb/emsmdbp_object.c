@@ -28,6 +28,7 @@
 
 #include <ctype.h>
 #include <time.h>
+#include <sys/mman.h>
 
 #include "mapiproxy/dcesrv_mapiproxy.h"
 #include "mapiproxy/libmapiproxy/libmapiproxy.h"
@@ -39,6 +40,11 @@
 
 #include "dcesrv_exchange_emsmdb.h"
 
+/* Pool allocated with each object: its type-specific data, the
+   reference on its parent and a few strings */
+#define	EMSMDBP_OBJECT_POOL_OBJECTS	4
+#define	EMSMDBP_OBJECT_POOL_SIZE	1024
+
 const char *emsmdbp_getstr_type(struct emsmdbp_object *object)
 {
 	switch (object->type) {
@@ -411,6 +417,14 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_object_create_folder(struct emsmdbp_context *em
 			OC_PANIC(true, ("PidTagChangeNumber *must* be present\n"));
 		}
 	}
+
+	parentFolderID = (parent_folder->type == EMSMDBP_OBJECT_MAILBOX) ? parent_folder->object.mailbox->folderID
+									 : parent_folder->object.folder->folderID;
+	emsmdbp_folder_update_recursive_counts(emsmdbp_ctx, parent_folder, parentFolderID, fid, 1, false);
+	if (emsmdbp_is_mailboxstore(parent_folder)) {
+		openchangedb_set_recursive_folder_count(emsmdbp_ctx->oc_ctx, emsmdbp_get_owner(parent_folder), fid, 0);
+	}
+	emsmdbp_folder_hierarchy_changed(emsmdbp_ctx, parent_folder, fid);
 	*new_folderp = new_folder;
 
 	return MAPI_E_SUCCESS;
@@ -480,7 +494,14 @@ _PUBLIC_ enum mapistore_error emsmdbp_object_open_folder(TALLOC_CTX *mem_ctx, st
 						parent->type));
 				break;
 			}
-			ret = openchangedb_get_parent_fid(emsmdbp_ctx->oc_ctx, mailbox_object->object.mailbox->owner_username, fid, &oc_parent_fid, mailbox_object->object.mailbox->mailboxstore);
+			/* a parent resolved earlier in the session is trusted
+			   as long as it matches, the database decides otherwise */
+			if (emsmdbp_folder_cache_get_parent(emsmdbp_ctx, mailbox_object->object.mailbox->owner_username, fid, &oc_parent_fid)
+			    && oc_parent_fid == parent_fid) {
+				ret = MAPI_E_SUCCESS;
+			} else {
+				ret = openchangedb_get_parent_fid(emsmdbp_ctx->oc_ctx, mailbox_object->object.mailbox->owner_username, fid, &oc_parent_fid, mailbox_object->object.mailbox->mailboxstore);
+			}
 			if (ret != MAPI_E_SUCCESS) {
 				OC_DEBUG(0, "folder %.16"PRIx64" or %.16"PRIx64" does not exist\n", parent_fid, fid);
 				talloc_free(local_ctx);
@@ -498,11 +519,70 @@ _PUBLIC_ enum mapistore_error emsmdbp_object_open_folder(TALLOC_CTX *mem_ctx, st
 		talloc_free(local_ctx);
 	}
 
+	mailbox_object = emsmdbp_get_mailbox(parent);
+	if (mailbox_object) {
+		emsmdbp_folder_cache_set_object(emsmdbp_ctx, mailbox_object->object.mailbox->owner_username, folder_object);
+	}
 	*folder_object_p = folder_object;
 
 	return MAPISTORE_SUCCESS;
 }
 
+/**
+   \details Reopen the backend object of a folder or read-only message
+   released while its session was hibernated
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param object pointer to the folder or message object, whose parent
+   is open
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error emsmdbp_object_reopen(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *object)
+{
+	struct emsmdbp_object	*parent;
+	enum mapistore_error	retval;
+	enum MAPISTATUS		ret;
+	char			*path;
+	char			*owner;
+	uint32_t		contextID;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !object || !object->parent_object) return MAPISTORE_ERR_INVALID_PARAMETER;
+
+	parent = object->parent_object;
+	switch (object->type) {
+	case EMSMDBP_OBJECT_FOLDER:
+		if (!object->object.folder->mapistore_root) {
+			if (!parent->backend_object) return MAPISTORE_ERR_NOT_FOUND;
+			return mapistore_folder_open_folder(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(parent), parent->backend_object,
+							    object, object->object.folder->folderID, &object->backend_object);
+		}
+
+		owner = emsmdbp_get_owner(object);
+		ret = openchangedb_get_mapistoreURI(object, emsmdbp_ctx->oc_ctx, owner, object->object.folder->folderID, &path, true);
+		if (ret != MAPI_E_SUCCESS || !path) return MAPISTORE_ERR_NOT_FOUND;
+
+		retval = mapistore_search_context_by_uri(emsmdbp_ctx->mstore_ctx, path, &contextID, &object->backend_object);
+		if (retval == MAPISTORE_SUCCESS) {
+			retval = mapistore_add_context_ref_count(emsmdbp_ctx->mstore_ctx, contextID);
+		} else {
+			retval = mapistore_add_context(emsmdbp_ctx->mstore_ctx, owner, path, object->object.folder->folderID, &contextID, &object->backend_object);
+		}
+		talloc_free(path);
+		if (retval != MAPISTORE_SUCCESS) return retval;
+
+		object->object.folder->contextID = contextID;
+		return MAPISTORE_SUCCESS;
+	case EMSMDBP_OBJECT_MESSAGE:
+		if (!parent->backend_object) return MAPISTORE_ERR_NOT_FOUND;
+		return mapistore_folder_open_message(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(parent), parent->backend_object,
+						     object, object->object.message->messageID, false, &object->backend_object);
+	default:
+		return MAPISTORE_ERR_INVALID_PARAMETER;
+	}
+}
+
 _PUBLIC_ int emsmdbp_get_uri_from_fid(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, uint64_t fid, char **urip)
 {
 	enum MAPISTATUS	retval;
@@ -567,6 +647,10 @@ static enum MAPISTATUS emsmdbp_get_parent_fid(struct emsmdbp_context *emsmdbp_ct
 	OPENCHANGE_RETVAL_IF(!mailbox_object, MAPI_E_INVALID_PARAMETER, NULL);
 	mailbox = mailbox_object->object.mailbox;
 
+	if (emsmdbp_folder_cache_get_parent(emsmdbp_ctx, mailbox->owner_username, fid, parent_fidp)) {
+		return MAPI_E_SUCCESS;
+	}
+
 	mem_ctx = talloc_zero(NULL, void);
 	retval = openchangedb_get_parent_fid(emsmdbp_ctx->oc_ctx, mailbox->owner_username, fid, parent_fidp, true);
 	if (retval == MAPI_E_SUCCESS) {
@@ -591,10 +675,139 @@ static enum MAPISTATUS emsmdbp_get_parent_fid(struct emsmdbp_context *emsmdbp_ct
 
 end:
 	talloc_free(mem_ctx);
+	if (retval == MAPI_E_SUCCESS) {
+		emsmdbp_folder_cache_set_parent(emsmdbp_ctx, mailbox->owner_username, fid, *parent_fidp);
+	}
 
 	return retval;
 }
 
+/* The deepest hierarchy walked up before giving up, guards against loops */
+#define EMSMDBP_FOLDER_MAX_DEPTH	64
+
+/**
+   \details Update the stored recursive folder counts after a folder
+   and, when subtree is set, its descendants were added under or
+   removed from parent_fid
+
+   The stored counts of parent_fid and of all its ancestors change by
+   the same amount. When that amount is not known (no count stored for
+   child_fid) or the ancestors can not be resolved, their counts are
+   cleared instead and computed again on the next lookup.
+
+   \param emsmdbp_ctx pointer to the emsmdbp context
+   \param context_object any object of the mailbox
+   \param parent_fid the folder the child was added under or removed from
+   \param child_fid the added or removed folder
+   \param sign 1 for an addition, -1 for a removal
+   \param subtree whether the descendants of child_fid moved with it
+ */
+_PUBLIC_ void emsmdbp_folder_update_recursive_counts(struct emsmdbp_context *emsmdbp_ctx,
+						     struct emsmdbp_object *context_object,
+						     uint64_t parent_fid, uint64_t child_fid,
+						     int32_t sign, bool subtree)
+{
+	struct emsmdbp_object	*mailbox_object;
+	const char		*owner;
+	uint64_t		fids[EMSMDBP_FOLDER_MAX_DEPTH];
+	uint32_t		count = 0;
+	uint32_t		descendants = 0;
+	uint64_t		fid;
+	bool			exact = true;
+	bool			resolved = false;
+	enum MAPISTATUS		retval;
+
+	if (!emsmdbp_ctx || !context_object) return;
+	mailbox_object = emsmdbp_get_mailbox(context_object);
+	/* Counts are only stored for private mailboxes */
+	if (!mailbox_object || !mailbox_object->object.mailbox->mailboxstore) return;
+	owner = mailbox_object->object.mailbox->owner_username;
+
+	if (subtree) {
+		retval = openchangedb_get_recursive_folder_count(emsmdbp_ctx->oc_ctx, owner, child_fid, &descendants);
+		exact = (retval == MAPI_E_SUCCESS);
+	}
+
+	/* parent_fid and its ancestors, up to the mailbox root */
+	fid = parent_fid;
+	while (fid && count < EMSMDBP_FOLDER_MAX_DEPTH) {
+		fids[count++] = fid;
+		if (fid == mailbox_object->object.mailbox->folderID) {
+			resolved = true;
+			break;
+		}
+		if (emsmdbp_get_parent_fid(emsmdbp_ctx, mailbox_object, fid, &fid) != MAPI_E_SUCCESS) {
+			break;
+		}
+	}
+
+	if (!resolved) {
+		openchangedb_clear_recursive_folder_counts(emsmdbp_ctx->oc_ctx, owner, 0, NULL);
+	} else if (!exact) {
+		openchangedb_clear_recursive_folder_counts(emsmdbp_ctx->oc_ctx, owner, count, fids);
+	} else {
+		retval = openchangedb_update_recursive_folder_counts(emsmdbp_ctx->oc_ctx, owner, count, fids,
+								     sign * (int32_t)(descendants + 1));
+		if (retval != MAPI_E_SUCCESS && retval != MAPI_E_NOT_IMPLEMENTED) {
+			openchangedb_clear_recursive_folder_counts(emsmdbp_ctx->oc_ctx, owner, 0, NULL);
+		}
+	}
+}
+
+/**
+   \details Raise the hierarchy change number of a folder and of all its
+   ancestors after the folder was created, changed or moved, or after
+   one of its subfolders was deleted
+
+   A new change number is allocated, the hierarchy synchronization of
+   any of these folders is walked again for clients which have not seen
+   it. When the ancestors can not be resolved, every hierarchy change
+   number of the mailbox is cleared instead.
+
+   \param emsmdbp_ctx pointer to the emsmdbp context
+   \param context_object any object of the mailbox
+   \param fid the changed folder
+ */
+_PUBLIC_ void emsmdbp_folder_hierarchy_changed(struct emsmdbp_context *emsmdbp_ctx,
+					       struct emsmdbp_object *context_object,
+					       uint64_t fid)
+{
+	struct emsmdbp_object	*mailbox_object;
+	const char		*owner;
+	uint64_t		fids[EMSMDBP_FOLDER_MAX_DEPTH];
+	uint32_t		count = 0;
+	uint64_t		cn;
+	bool			resolved = false;
+	enum MAPISTATUS		retval;
+
+	if (!emsmdbp_ctx || !context_object) return;
+	mailbox_object = emsmdbp_get_mailbox(context_object);
+	/* Change numbers are only stored for private mailboxes */
+	if (!mailbox_object || !mailbox_object->object.mailbox->mailboxstore) return;
+	owner = mailbox_object->object.mailbox->owner_username;
+
+	/* fid and its ancestors, up to the mailbox root */
+	while (fid && count < EMSMDBP_FOLDER_MAX_DEPTH) {
+		fids[count++] = fid;
+		if (fid == mailbox_object->object.mailbox->folderID) {
+			resolved = true;
+			break;
+		}
+		if (emsmdbp_get_parent_fid(emsmdbp_ctx, mailbox_object, fid, &fid) != MAPI_E_SUCCESS) {
+			break;
+		}
+	}
+
+	if (resolved) {
+		retval = emsmdbp_change_number(emsmdbp_ctx, owner, &cn);
+		if (retval == MAPI_E_SUCCESS) {
+			retval = openchangedb_set_hierarchy_change_numbers(emsmdbp_ctx->oc_ctx, owner, count, fids, cn);
+		}
+		if (retval == MAPI_E_SUCCESS || retval == MAPI_E_NOT_IMPLEMENTED) return;
+	}
+	openchangedb_clear_hierarchy_change_numbers(emsmdbp_ctx->oc_ctx, owner, 0, NULL);
+}
+
 /**
    \details Return the folder object associated to specified folder identified
 
@@ -614,6 +827,7 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_object_open_folder_by_fid(TALLOC_CTX *mem_ctx,
 							   struct emsmdbp_object **folder_object_p)
 {
 	uint64_t		parent_fid;
+	bool			cached;
 	enum mapistore_error	ret;
 	enum MAPISTATUS		retval;
 	struct emsmdbp_object   *mailbox_object;
@@ -636,16 +850,32 @@ _PUBLIC_ enum MAPISTATUS emsmdbp_object_open_folder_by_fid(TALLOC_CTX *mem_ctx,
 		return MAPI_E_SUCCESS;
 	}
 
+	cached = emsmdbp_folder_cache_get_parent(emsmdbp_ctx, mailbox_object->object.mailbox->owner_username, fid, &parent_fid);
 	retval = emsmdbp_get_parent_fid(emsmdbp_ctx, mailbox_object, fid, &parent_fid);
 	if (retval == MAPI_E_SUCCESS) {
 		if (parent_fid) {
 			struct emsmdbp_object	*parent_object = NULL;
 
-			retval = emsmdbp_object_open_folder_by_fid(mem_ctx, emsmdbp_ctx, context_object, parent_fid, &parent_object);
-			if (retval != MAPI_E_SUCCESS) {
-				return retval;
+			/* A parent folder still open in this session is
+			   reused instead of opening the whole chain again.
+			   The requested folder itself is always opened anew:
+			   its caller owns it. */
+			parent_object = emsmdbp_folder_cache_get_object(emsmdbp_ctx, mailbox_object->object.mailbox->owner_username, parent_fid);
+			if (parent_object) {
+				cached = true;
+			} else {
+				retval = emsmdbp_object_open_folder_by_fid(mem_ctx, emsmdbp_ctx, context_object, parent_fid, &parent_object);
+				if (retval != MAPI_E_SUCCESS) {
+					return retval;
+				}
 			}
 			ret = emsmdbp_object_open_folder(mem_ctx, emsmdbp_ctx, parent_object, fid, folder_object_p);
+			if (ret == MAPISTORE_ERR_NOT_FOUND && cached) {
+				/* the hierarchy changed behind the session,
+				   resolve it again from the databases */
+				emsmdbp_folder_cache_reset(emsmdbp_ctx);
+				return emsmdbp_object_open_folder_by_fid(mem_ctx, emsmdbp_ctx, context_object, fid, folder_object_p);
+			}
 			return mapistore_error_to_mapi(ret);
 		}
 		else {
@@ -662,10 +892,8 @@ _PUBLIC_ int emsmdbp_object_stream_commit(struct emsmdbp_object *stream_object)
 	int				rc;
 	struct emsmdbp_object_stream	*stream;
         void				*stream_data;
-        uint8_t				*utf8_buffer;
         struct Binary_r			*binary_data;
         struct SRow			aRow;
-	size_t				converted_size;
 	uint16_t			propType;
 
 	if (!stream_object || stream_object->type != EMSMDBP_OBJECT_STREAM) return MAPISTORE_ERROR;
@@ -673,7 +901,12 @@ _PUBLIC_ int emsmdbp_object_stream_commit(struct emsmdbp_object *stream_object)
 	stream = stream_object->object.stream;
 
 	rc = MAPISTORE_SUCCESS;
-	if (stream->needs_commit) {
+	if (stream->needs_commit && stream->backend_stream) {
+		stream->needs_commit = false;
+		rc = mapistore_stream_commit(stream_object->emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(stream_object),
+					     stream->backend_stream, stream->backend_size);
+	}
+	else if (stream->needs_commit) {
 		stream->needs_commit = false;
 		aRow.cValues = 1;
 		aRow.lpProps = talloc_zero(NULL, struct SPropValue);
@@ -686,16 +919,14 @@ _PUBLIC_ int emsmdbp_object_stream_commit(struct emsmdbp_object *stream_object)
 			stream_data = binary_data;
 		}
 		else if (propType == PT_STRING8) {
+			/* Written streams are NUL terminated, see
+			   emsmdbp_stream_write_buffer */
 			stream_data = stream->stream.buffer.data;
 		}
 		else {
 			/* PT_UNICODE */
-			utf8_buffer = talloc_array(aRow.lpProps, uint8_t, stream->stream.buffer.length + 2);
-			convert_string(CH_UTF16LE, CH_UTF8,
-				       stream->stream.buffer.data, stream->stream.buffer.length,
-				       utf8_buffer, stream->stream.buffer.length, &converted_size);
-			utf8_buffer[converted_size] = 0;
-			stream_data = utf8_buffer;
+			stream_data = mapi_utf16_pull_talloc(aRow.lpProps, stream->stream.buffer.data,
+							     stream->stream.buffer.length);
 		}
 		set_SPropValue_proptag(aRow.lpProps, stream->property, stream_data);
 
@@ -706,6 +937,21 @@ _PUBLIC_ int emsmdbp_object_stream_commit(struct emsmdbp_object *stream_object)
 	return rc;
 }
 
+/**
+   \details Return the size of the content of a stream object
+
+   \param stream pointer to the stream object
+
+   \return the size in bytes of the stream
+ */
+_PUBLIC_ uint64_t emsmdbp_object_stream_get_size(struct emsmdbp_object_stream *stream)
+{
+	if (stream->backend_stream) {
+		return stream->backend_size;
+	}
+	return stream->stream.buffer.length;
+}
+
 /**
    \details talloc destructor for emsmdbp_objects
 
@@ -723,6 +969,8 @@ static int emsmdbp_object_destructor(void *data)
 	struct timeval		request_end, request_delta;
 
 	if (!data) return -1;
+	emsmdbp_stats_object(object->type, false);
+	emsmdbp_folder_cache_forget_object(object);
 	if (!emsmdbp_is_mapistore(object)) goto nomapistore;
 
 	OC_DEBUG(4, "emsmdbp %s object released\n", emsmdbp_getstr_type(object));
@@ -730,7 +978,8 @@ static int emsmdbp_object_destructor(void *data)
 	contextID = emsmdbp_get_contextID(object);
 	switch (object->type) {
 	case EMSMDBP_OBJECT_FOLDER:
-		if (object->object.folder->mapistore_root) {
+		/* a hibernated folder gave its context back already */
+		if (object->object.folder->mapistore_root && !object->hibernated) {
 			ret = mapistore_del_context(object->emsmdbp_ctx->mstore_ctx, contextID);
 		}
 		OC_DEBUG(4, "mapistore folder context retval = %d\n", ret);
@@ -802,8 +1051,16 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_init(TALLOC_CTX *mem_ctx, struct
 {
 	struct emsmdbp_object	*object = NULL;
 
+	/* One allocation for the object and the data its type-specific
+	   init function adds to it */
+#ifdef talloc_pooled_object
+	object = talloc_pooled_object(mem_ctx, struct emsmdbp_object, EMSMDBP_OBJECT_POOL_OBJECTS, EMSMDBP_OBJECT_POOL_SIZE);
+	if (!object) return NULL;
+	memset(object, 0, sizeof (struct emsmdbp_object));
+#else
 	object = talloc_zero(mem_ctx, struct emsmdbp_object);
 	if (!object) return NULL;
+#endif
 
 	talloc_set_destructor((void *)object, (int (*)(void *))emsmdbp_object_destructor);
 
@@ -823,6 +1080,35 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_init(TALLOC_CTX *mem_ctx, struct
 	return object;
 }
 
+/**
+   \details Set the type of an initialized emsmdbp_object, once its
+   type-specific data is allocated, and account it in the statistics
+
+   \param object pointer to the emsmdbp object
+   \param type the type of the object
+ */
+static void emsmdbp_object_set_type(struct emsmdbp_object *object, enum emsmdbp_object_type type)
+{
+	object->type = type;
+	emsmdbp_stats_object(type, true);
+}
+
+/* Properties identifying an object, never copied to another object */
+static const enum MAPITAGS emsmdbp_copy_identity_tags[] = {
+	PidTagRowType,
+	PidTagInstanceKey,
+	PidTagInstanceNum,
+	PidTagInstID,
+	PidTagFolderId,
+	PidTagMid,
+	PidTagSourceKey,
+	PidTagParentSourceKey,
+	PidTagParentFolderId,
+	PidTagChangeNumber,
+	PidTagChangeKey,
+	PidTagPredecessorChangeList
+};
+
 static int emsmdbp_copy_properties(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *source_object, struct emsmdbp_object *dest_object, struct SPropTagArray *excluded_tags)
 {
 	TALLOC_CTX		*mem_ctx;
@@ -848,18 +1134,9 @@ static int emsmdbp_copy_properties(struct emsmdbp_context *emsmdbp_ctx, struct e
 	memset(properties_exclusion, 0, 65536 * sizeof(bool));
 
 	/* 1a. Explicit exclusions */
-	properties_exclusion[(uint16_t) (PidTagRowType >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagInstanceKey >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagInstanceNum >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagInstID >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagFolderId >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagMid >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagSourceKey >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagParentSourceKey >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagParentFolderId >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagChangeNumber >> 16)] = true;
-	properties_exclusion[(uint16_t) (PidTagChangeKey >> 16)] = true;	
-	properties_exclusion[(uint16_t) (PidTagPredecessorChangeList >> 16)] = true;	
+	for (i = 0; i < sizeof(emsmdbp_copy_identity_tags) / sizeof(enum MAPITAGS); i++) {
+		properties_exclusion[(uint16_t) (emsmdbp_copy_identity_tags[i] >> 16)] = true;
+	}
 
 	/* 1b. Request exclusions */
 	if (excluded_tags != NULL) {
@@ -1225,9 +1502,67 @@ end:
 }
 
 
+/**
+   \details Let the backend copy an object onto another object of the
+   same mapistore context
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param source_object pointer to the source object
+   \param target_object pointer to the target object
+   \param excluded_properties pointer to a SPropTagArray listing properties that must not be copied
+   \param deep_copy indicates whether subobjects must be copied
+
+   \return MAPISTORE_SUCCESS on success, MAPISTORE_ERR_NOT_IMPLEMENTED
+   when the objects must be copied with the generic path, otherwise
+   MAPISTORE error
+ */
+static enum mapistore_error emsmdbp_copy_object_mapistore(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *source_object, struct emsmdbp_object *target_object, struct SPropTagArray *excluded_properties, bool deep_copy)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct SPropTagArray	*excluded_tags;
+	uint32_t		contextID, i;
+	enum mapistore_error	ret;
+
+	if (!emsmdbp_is_mapistore(source_object) || !emsmdbp_is_mapistore(target_object)) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+	contextID = emsmdbp_get_contextID(source_object);
+	if (contextID != emsmdbp_get_contextID(target_object)) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	excluded_tags = talloc_zero(mem_ctx, struct SPropTagArray);
+	MAPISTORE_RETVAL_IF(!excluded_tags, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+	excluded_tags->aulPropTag = talloc_zero(excluded_tags, void);
+	MAPISTORE_RETVAL_IF(!excluded_tags->aulPropTag, MAPISTORE_ERR_NO_MEMORY, mem_ctx);
+
+	for (i = 0; i < sizeof(emsmdbp_copy_identity_tags) / sizeof(enum MAPITAGS); i++) {
+		SPropTagArray_add(mem_ctx, excluded_tags, emsmdbp_copy_identity_tags[i]);
+	}
+	if (excluded_properties) {
+		for (i = 0; i < excluded_properties->cValues; i++) {
+			SPropTagArray_add(mem_ctx, excluded_tags, excluded_properties->aulPropTag[i]);
+		}
+	}
+
+	ret = mapistore_properties_copy_object(emsmdbp_ctx->mstore_ctx, contextID,
+					       source_object->backend_object, target_object->backend_object,
+					       excluded_tags, deep_copy);
+	talloc_free(mem_ctx);
+
+	return ret;
+}
+
 /**
    \details Copy properties from an object to another object
 
+   Objects of the same mapistore context are copied by the backend
+   when it supports it, otherwise the properties, recipients and
+   attachments are fetched and set one object at a time.
+
    \param emsmdbp_ctx pointer to the emsmdb provider context
    \param source_object pointer to the source object
    \param target_object pointer to the target object
@@ -1238,7 +1573,8 @@ end:
  */
 _PUBLIC_ int emsmdbp_object_copy_properties(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *source_object, struct emsmdbp_object *target_object, struct SPropTagArray *excluded_properties, bool deep_copy)
 {
-	int ret;
+	int			ret;
+	enum mapistore_error	mretval;
 
 	if (!(source_object->type == EMSMDBP_OBJECT_FOLDER
 	      || source_object->type == EMSMDBP_OBJECT_MAILBOX
@@ -1254,6 +1590,13 @@ _PUBLIC_ int emsmdbp_object_copy_properties(struct emsmdbp_context *emsmdbp_ctx,
 		goto end;
 	}
 
+	/* same backend context: copy in the store */
+	mretval = emsmdbp_copy_object_mapistore(emsmdbp_ctx, source_object, target_object, excluded_properties, deep_copy);
+	if (mretval != MAPISTORE_ERR_NOT_IMPLEMENTED) {
+		ret = mapistore_error_to_mapi(mretval);
+		goto end;
+	}
+
 	/* copy properties (common to all object types) */
 	ret = emsmdbp_copy_properties(emsmdbp_ctx, source_object, target_object, excluded_properties);
 	if (ret != MAPI_E_SUCCESS) {
@@ -1326,7 +1669,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_mailbox_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_MAILBOX;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_MAILBOX);
 	object->object.mailbox->owner_Name = NULL;
 	object->object.mailbox->owner_EssDN = NULL;
 	object->object.mailbox->szUserDN = NULL;
@@ -1397,7 +1740,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_folder_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_FOLDER;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_FOLDER);
 	object->object.folder->folderID = folderID;
 	object->object.folder->mapistore_root = false;
 	object->object.folder->contextID = (uint32_t) -1;
@@ -1441,6 +1784,11 @@ enum MAPISTATUS emsmdbp_folder_get_folder_count(struct emsmdbp_context *emsmdbp_
    \details Return the full number of folders within specified
    folder's hierarchy
 
+   The count stored in openchangedb is used when there is one.
+   Otherwise the hierarchy is walked and the count of every folder
+   walked is stored; emsmdbp_folder_update_recursive_counts() keeps
+   them up to date afterwards.
+
    \param emsmdbp_ctx pointer to the emsmdbp context
    \param folder pointer to the emsmdb folder to start the count from
    \param row_countp pointer on the number of folders to return
@@ -1453,15 +1801,33 @@ enum MAPISTATUS emsmdbp_folder_get_recursive_folder_count(struct emsmdbp_context
 {
 	enum MAPISTATUS		retval = MAPI_E_SUCCESS;
 	struct emsmdbp_object	*table_object;
+	struct emsmdbp_object	*mailbox_object;
 	uint32_t		count = 0;
+	uint32_t		total = 0;
 	struct mapi_handles	*rec = NULL;
 	uint32_t		i;
 	struct SPropTagArray	*SPropTagArray = NULL;
 	uint32_t		handle = 0;
+	const char		*owner = NULL;
+	uint64_t		folderID;
+	bool			complete = true;
+
+	mailbox_object = emsmdbp_get_mailbox(folder);
+	if (mailbox_object && mailbox_object->object.mailbox->mailboxstore) {
+		owner = mailbox_object->object.mailbox->owner_username;
+	}
+	folderID = (folder->type == EMSMDBP_OBJECT_MAILBOX) ? folder->object.mailbox->folderID
+							   : folder->object.folder->folderID;
+
+	if (owner && openchangedb_get_recursive_folder_count(emsmdbp_ctx->oc_ctx, owner, folderID,
+							     &total) == MAPI_E_SUCCESS) {
+		*row_countp += total;
+		return MAPI_E_SUCCESS;
+	}
 
 	retval = emsmdbp_folder_get_folder_count(emsmdbp_ctx, folder, &count);
 	if ((retval == MAPI_E_SUCCESS) && count) {
-		*row_countp += count;
+		total += count;
 
 		retval = mapi_handles_add(emsmdbp_ctx->handles_ctx, handle, &rec);
 		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
@@ -1502,18 +1868,31 @@ enum MAPISTATUS emsmdbp_folder_get_recursive_folder_count(struct emsmdbp_context
 					uint32_t scount = 0;
 
 					retval = emsmdbp_folder_get_recursive_folder_count(emsmdbp_ctx, sfolder, &scount);
-					*row_countp += scount;
+					total += scount;
 					talloc_free(sfolder);
 				}
+				if (retval != MAPI_E_SUCCESS) {
+					complete = false;
+				}
 				talloc_free(data_pointers);
 				talloc_free(retvals);
+			} else {
+				complete = false;
 			}
 		}
 		talloc_free(table_object->object.table->properties);
 		talloc_free(SPropTagArray);
 		talloc_free(table_object);
 		mapi_handles_delete(emsmdbp_ctx->handles_ctx, rec->handle);
+	} else if (retval != MAPI_E_SUCCESS) {
+		complete = false;
+	}
+
+	/* Only a full walk gives a count worth keeping */
+	if (owner && complete) {
+		openchangedb_set_recursive_folder_count(emsmdbp_ctx->oc_ctx, owner, folderID, total);
 	}
+	*row_countp += total;
 end:
 	return retval;
 }
@@ -1593,6 +1972,7 @@ _PUBLIC_ enum mapistore_error emsmdbp_folder_move_folder(struct emsmdbp_context
 	uint32_t		contextID;
 	int			system_idx;
 	bool			is_top_of_IS, is_special;
+	uint64_t		old_parent_fid;
 
 	/* TODO: we should provide the ability to perform this operation between non-mapistore objects or between mapistore and non-mapistore objects */
 	if (!emsmdbp_is_mapistore(move_folder)) {
@@ -1626,6 +2006,12 @@ _PUBLIC_ enum mapistore_error emsmdbp_folder_move_folder(struct emsmdbp_context
 		}
 	}
 
+	/* The old parent is no longer found once the folder moved */
+	if (emsmdbp_get_parent_fid(emsmdbp_ctx, emsmdbp_get_mailbox(move_folder),
+				   move_folder->object.folder->folderID, &old_parent_fid) != MAPI_E_SUCCESS) {
+		old_parent_fid = 0;
+	}
+
 	contextID = emsmdbp_get_contextID(move_folder);
 	if (is_top_of_IS) {
 		/* We move it in MAPIStore backend and then we create
@@ -1650,101 +2036,365 @@ _PUBLIC_ enum mapistore_error emsmdbp_folder_move_folder(struct emsmdbp_context
 		}
 	}
 
+	if (ret == MAPISTORE_SUCCESS) {
+		emsmdbp_folder_cache_reset(emsmdbp_ctx);
+		emsmdbp_folder_update_recursive_counts(emsmdbp_ctx, move_folder, old_parent_fid,
+						       move_folder->object.folder->folderID, -1, true);
+		emsmdbp_folder_update_recursive_counts(emsmdbp_ctx, target_folder, target_folder->object.folder->folderID,
+						       move_folder->object.folder->folderID, 1, true);
+		emsmdbp_folder_hierarchy_changed(emsmdbp_ctx, move_folder, old_parent_fid);
+		emsmdbp_folder_hierarchy_changed(emsmdbp_ctx, move_folder, move_folder->object.folder->folderID);
+	}
+
 	return ret;
 }
 
 /**
-   \details  Delete the fmids from a folder in the indexing database.
+   \details Build the change keys and predecessor change lists of a
+   batch of messages from a block of change numbers
 
-   \param mstore_ctx pointer to the mapistore context
-   \param context_id the context identifier
-   \param username the owner of the folder to delete its entries
-   \param fid the folder identifier
-   \param deleted_fmid the array of child fmids from the folder
-   \param deleted_fmid_count the number of deleted_fmids
-   \param flags the delete flags. See emsmdbp_folder_delete for details.
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param count number of messages
+   \param change_keysp pointer to the array of change keys to return
+   \param predecessor_change_listsp pointer to the array of predecessor
+   change lists to return
 
-   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error.
-*/
-_PUBLIC_ enum mapistore_error emsmdbp_folder_delete_indexing_records(struct mapistore_context *mstore_ctx, uint32_t context_id, char *username, uint64_t fid, uint64_t *deleted_fmids, uint32_t deleted_fmids_count, uint8_t flags)
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_folder_new_change_keys(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, uint32_t count,
+						      struct Binary_r ***change_keysp, struct Binary_r ***predecessor_change_listsp)
 {
-        enum mapistore_error    ret;
-        uint8_t                 delete_type_flag;
-        uint32_t                i;
+	enum MAPISTATUS		retval;
+	struct UI8Array_r	*cns;
+	struct Binary_r		**change_keys, **predecessor_change_lists, *pcl;
+	uint32_t		i;
 
-        delete_type_flag = (flags & DELETE_HARD_DELETE) ? MAPISTORE_PERMANENT_DELETE : MAPISTORE_SOFT_DELETE;
-        ret = mapistore_indexing_record_del_fid(mstore_ctx, context_id, username, fid, delete_type_flag);
-        MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+	retval = openchangedb_get_new_changeNumbers(emsmdbp_ctx->oc_ctx, mem_ctx, emsmdbp_ctx->username, count, &cns);
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, NULL);
 
-        for (i = 0; i < deleted_fmids_count; i++) {
-                ret = mapistore_indexing_record_del_fid(mstore_ctx, context_id, username,
-                                                        deleted_fmids[i], delete_type_flag);
-                MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
-        }
+	change_keys = talloc_array(mem_ctx, struct Binary_r *, count);
+	OPENCHANGE_RETVAL_IF(!change_keys, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	predecessor_change_lists = talloc_array(mem_ctx, struct Binary_r *, count);
+	OPENCHANGE_RETVAL_IF(!predecessor_change_lists, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	for (i = 0; i < count; i++) {
+		/* XID: replica GUID followed by the 6 bytes global counter */
+		if (emsmdbp_source_key_from_fmid(change_keys, emsmdbp_ctx, emsmdbp_ctx->username, cns->lpui8[i], &change_keys[i]) != MAPISTORE_SUCCESS) {
+			return MAPI_E_NOT_FOUND;
+		}
+
+		/* PCL: a single SizedXid */
+		pcl = talloc_zero(predecessor_change_lists, struct Binary_r);
+		OPENCHANGE_RETVAL_IF(!pcl, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		pcl->cb = change_keys[i]->cb + 1;
+		pcl->lpb = talloc_array(pcl, uint8_t, pcl->cb);
+		OPENCHANGE_RETVAL_IF(!pcl->lpb, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		pcl->lpb[0] = change_keys[i]->cb;
+		memcpy(pcl->lpb + 1, change_keys[i]->lpb, change_keys[i]->cb);
+		predecessor_change_lists[i] = pcl;
+	}
 
-        return MAPISTORE_SUCCESS;
+	*change_keysp = change_keys;
+	*predecessor_change_listsp = predecessor_change_lists;
+
+	return MAPI_E_SUCCESS;
 }
 
 /**
-   \details Delete a folder.
-
-   \param emsmdbp_ctx pointer to the emsmdbp context
-   \param parent_folder the parent folder
-   \param fid the folder identifier to delete from parent_folder
-   \param flags the delete flags.
+   \details Copy a message to a folder of another mapistore context
+   through the generic property copy path
 
-   Possible values for flags are:
-   -# DEL_MESSAGES Delete all the messages in the folder
-   -# DEL_FOLDERS Delete the subfolder and all of its subfolders
-   -# DELETE_HARD_DELETE Hard delete the folder
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param source_folder pointer to the folder holding the message
+   \param target_folder pointer to the folder receiving the copy
+   \param source_mid the identifier of the message to copy
+   \param target_mid the identifier of the copy
 
-   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error.
-*/
-_PUBLIC_ enum mapistore_error emsmdbp_folder_delete(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *parent_folder, uint64_t fid, uint8_t flags)
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+static enum mapistore_error emsmdbp_folder_copy_message_generic(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+								struct emsmdbp_object *source_folder, struct emsmdbp_object *target_folder,
+								uint64_t source_mid, uint64_t target_mid)
 {
+	TALLOC_CTX		*local_mem_ctx;
+	struct emsmdbp_object	*source_message, *target_message;
+	struct SPropTagArray	*props;
+	void			**data_pointers;
+	enum MAPISTATUS		*retvals = NULL;
 	enum mapistore_error	ret;
-	enum MAPISTATUS		retval;
-	TALLOC_CTX		*mem_ctx;
-	bool			mailboxstore;
-	uint32_t		context_id, deleted_fmids_count;
-	void			*subfolder;
-	char			*mapistoreURL;
-	uint64_t		*deleted_fmids;
+	uint8_t			associated = 0;
+	int			retval;
 
-	mem_ctx = talloc_new(NULL);
-	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+	local_mem_ctx = talloc_new(mem_ctx);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
 
-	/* Check if it is a special folder */
-	if (oxosfld_is_special_folder(emsmdbp_ctx, fid)) {
-		OC_DEBUG(1, "Attempt to delete special folder: 0x%"PRIx64, fid);
-		ret = MAPISTORE_ERR_DENIED;
-		goto end;
+	ret = emsmdbp_object_message_open(local_mem_ctx, emsmdbp_ctx, source_folder, source_folder->object.folder->folderID,
+					  source_mid, false, &source_message, NULL);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
+
+	props = talloc_zero(local_mem_ctx, struct SPropTagArray);
+	MAPISTORE_RETVAL_IF(!props, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+	props->cValues = 1;
+	props->aulPropTag = talloc_zero(props, enum MAPITAGS);
+	MAPISTORE_RETVAL_IF(!props->aulPropTag, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+	props->aulPropTag[0] = PidTagAssociated;
+	data_pointers = emsmdbp_object_get_properties(local_mem_ctx, emsmdbp_ctx, source_message, props, &retvals);
+	if (data_pointers && retvals[0] == MAPI_E_SUCCESS) {
+		associated = *((uint8_t *) data_pointers[0]) ? 1 : 0;
 	}
 
-	mailboxstore = emsmdbp_is_mailboxstore(parent_folder);
-	if (emsmdbp_is_mapistore(parent_folder)) {	/* fid is not a mapistore root */
-		OC_DEBUG(3, "Deleting mapistore folder\n");
-		/* handled by mapistore */
-		context_id = emsmdbp_get_contextID(parent_folder);
+	target_message = emsmdbp_object_message_init(local_mem_ctx, emsmdbp_ctx, target_mid, target_folder);
+	MAPISTORE_RETVAL_IF(!target_message, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+	target_message->object.message->read_write = true;
 
-		ret = mapistore_folder_open_folder(emsmdbp_ctx->mstore_ctx, context_id, parent_folder->backend_object, mem_ctx, fid, &subfolder);
-		if (ret != MAPISTORE_SUCCESS) {
-			goto end;
-		}
+	ret = mapistore_folder_create_message(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(target_folder),
+					      target_folder->backend_object, target_message, target_mid, associated,
+					      &target_message->backend_object);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
 
-		ret = mapistore_folder_delete(emsmdbp_ctx->mstore_ctx, context_id, subfolder, flags, mem_ctx, &deleted_fmids, &deleted_fmids_count);
-		if (ret != MAPISTORE_SUCCESS) {
-			goto end;
-		}
+	retval = emsmdbp_object_copy_properties(emsmdbp_ctx, source_message, target_message, NULL, true);
+	MAPISTORE_RETVAL_IF(retval != MAPI_E_SUCCESS, MAPISTORE_ERROR, local_mem_ctx);
 
-		/* Update indexing entries */
-		ret = emsmdbp_folder_delete_indexing_records(emsmdbp_ctx->mstore_ctx, context_id,
-							     emsmdbp_get_owner(parent_folder),
-							     fid, deleted_fmids, deleted_fmids_count,
-							     flags);
-		if (ret != MAPISTORE_SUCCESS) {
-			goto end;
-		}
+	ret = mapistore_message_save(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(target_folder),
+				     target_message->backend_object, local_mem_ctx);
+
+	talloc_free(local_mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Move or copy a set of messages from a folder to another
+
+   Messages moved within a mapistore context are handed to the backend
+   in a single operation, with their new identifiers and change keys
+   allocated in one block. Messages moved across contexts are copied
+   one at a time and deleted from the source folder afterwards. In
+   both cases the indexing database is updated once for the whole set.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param source_folder pointer to the folder holding the messages
+   \param target_folder pointer to the folder receiving the messages
+   \param mem_ctx pointer to the memory context
+   \param count number of messages
+   \param source_mids array of message identifiers to move or copy
+   \param want_copy whether the messages are copied rather than moved
+   \param partial_completionp pointer to the partial completion flag,
+   set when some of the messages could not be moved or copied
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error emsmdbp_folder_move_copy_messages(struct emsmdbp_context *emsmdbp_ctx,
+								struct emsmdbp_object *source_folder,
+								struct emsmdbp_object *target_folder,
+								TALLOC_CTX *mem_ctx, uint32_t count,
+								uint64_t *source_mids, bool want_copy,
+								bool *partial_completionp)
+{
+	TALLOC_CTX		*local_mem_ctx;
+	struct UI8Array_r	*target_mids;
+	struct Binary_r		**change_keys, **predecessor_change_lists;
+	uint64_t		*done_source_mids, *done_target_mids;
+	uint32_t		source_contextID, target_contextID, done, i;
+	enum mapistore_error	ret;
+	enum MAPISTATUS		retval;
+
+	/* Sanity checks */
+	MAPISTORE_RETVAL_IF(!emsmdbp_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!source_folder || source_folder->type != EMSMDBP_OBJECT_FOLDER, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!target_folder || target_folder->type != EMSMDBP_OBJECT_FOLDER, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(count && !source_mids, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!partial_completionp, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	*partial_completionp = false;
+	if (!count) return MAPISTORE_SUCCESS;
+
+	/* TODO: we should provide the ability to perform this operation between non-mapistore objects */
+	if (!emsmdbp_is_mapistore(source_folder) || !emsmdbp_is_mapistore(target_folder)) {
+		return MAPISTORE_ERR_NOT_IMPLEMENTED;
+	}
+
+	local_mem_ctx = talloc_new(mem_ctx);
+	MAPISTORE_RETVAL_IF(!local_mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* Allocate the identifiers of the new messages in one block */
+	ret = mapistore_indexing_get_new_folderIDs(emsmdbp_ctx->mstore_ctx, local_mem_ctx, count, &target_mids);
+	MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
+
+	source_contextID = emsmdbp_get_contextID(source_folder);
+	target_contextID = emsmdbp_get_contextID(target_folder);
+
+	if (source_contextID == target_contextID) {
+		/* Same backend context: a single backend operation */
+		retval = emsmdbp_folder_new_change_keys(local_mem_ctx, emsmdbp_ctx, count, &change_keys, &predecessor_change_lists);
+		MAPISTORE_RETVAL_IF(retval != MAPI_E_SUCCESS, mapi_error_to_mapistore(retval), local_mem_ctx);
+
+		ret = mapistore_folder_move_copy_messages(emsmdbp_ctx->mstore_ctx, target_contextID,
+							  target_folder->backend_object, source_folder->backend_object,
+							  local_mem_ctx, count, source_mids, target_mids->lpui8,
+							  change_keys, predecessor_change_lists, want_copy);
+		MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, local_mem_ctx);
+
+		done = count;
+		done_source_mids = source_mids;
+		done_target_mids = target_mids->lpui8;
+	}
+	else {
+		/* Across contexts: copy each message, then delete the source */
+		done_source_mids = talloc_array(local_mem_ctx, uint64_t, count);
+		MAPISTORE_RETVAL_IF(!done_source_mids, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+		done_target_mids = talloc_array(local_mem_ctx, uint64_t, count);
+		MAPISTORE_RETVAL_IF(!done_target_mids, MAPISTORE_ERR_NO_MEMORY, local_mem_ctx);
+
+		done = 0;
+		for (i = 0; i < count; i++) {
+			ret = emsmdbp_folder_copy_message_generic(local_mem_ctx, emsmdbp_ctx, source_folder, target_folder,
+								  source_mids[i], target_mids->lpui8[i]);
+			if (ret == MAPISTORE_SUCCESS && !want_copy) {
+				ret = mapistore_folder_delete_message(emsmdbp_ctx->mstore_ctx, source_contextID,
+								      source_folder->backend_object, source_mids[i],
+								      MAPISTORE_SOFT_DELETE);
+			}
+			if (ret != MAPISTORE_SUCCESS) {
+				OC_DEBUG(5, "unable to %s message 0x%.16"PRIx64": %s\n", want_copy ? "copy" : "move",
+					 source_mids[i], mapistore_errstr(ret));
+				*partial_completionp = true;
+				continue;
+			}
+			done_source_mids[done] = source_mids[i];
+			done_target_mids[done] = target_mids->lpui8[i];
+			done++;
+		}
+	}
+
+	/* Update the indexing database once for the whole set. Some
+	   backends register the records themselves. */
+	ret = mapistore_indexing_record_add_fmids(emsmdbp_ctx->mstore_ctx, target_contextID, emsmdbp_get_owner(target_folder),
+						  done, done_target_mids, NULL);
+	if (ret != MAPISTORE_SUCCESS && ret != MAPISTORE_ERR_EXIST) {
+		OC_DEBUG(3, "unable to index %"PRIu32" new messages: %s\n", done, mapistore_errstr(ret));
+	}
+	if (!want_copy) {
+		ret = mapistore_indexing_record_del_fmids(emsmdbp_ctx->mstore_ctx, source_contextID, emsmdbp_get_owner(source_folder),
+							  done, done_source_mids, MAPISTORE_SOFT_DELETE);
+		if (ret != MAPISTORE_SUCCESS && ret != MAPISTORE_ERR_NOT_FOUND) {
+			OC_DEBUG(3, "unable to remove %"PRIu32" moved messages from indexing: %s\n", done, mapistore_errstr(ret));
+		}
+		emsmdbp_freebusy_messages_deleted(emsmdbp_ctx, source_folder, done, done_source_mids);
+		emsmdbp_content_index_messages_deleted(emsmdbp_ctx, source_folder, done, done_source_mids);
+		emsmdbp_tombstones_messages_deleted(emsmdbp_ctx, source_folder, done, done_source_mids);
+	}
+	emsmdbp_conversations_messages_copied(emsmdbp_ctx, target_folder, done, done_source_mids, done_target_mids, !want_copy);
+	if (done) {
+		emsmdbp_freebusy_folder_changed(emsmdbp_ctx, target_folder);
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, target_folder);
+		if (!want_copy) {
+			emsmdbp_message_counts_folder_changed(emsmdbp_ctx, source_folder);
+		}
+	}
+	for (i = 0; i < done; i++) {
+		if (!want_copy) {
+			emsmdbp_search_message_removed(emsmdbp_ctx, source_folder->object.folder->folderID, done_source_mids[i]);
+		}
+		emsmdbp_search_message_changed(emsmdbp_ctx, target_folder->object.folder->folderID, done_target_mids[i]);
+		emsmdbp_content_index_message_changed(emsmdbp_ctx, target_folder, done_target_mids[i]);
+	}
+
+	talloc_free(local_mem_ctx);
+
+	return (done || !count) ? MAPISTORE_SUCCESS : MAPISTORE_ERROR;
+}
+
+/**
+   \details  Delete the fmids from a folder in the indexing database.
+
+   \param mstore_ctx pointer to the mapistore context
+   \param context_id the context identifier
+   \param username the owner of the folder to delete its entries
+   \param fid the folder identifier
+   \param deleted_fmid the array of child fmids from the folder
+   \param deleted_fmid_count the number of deleted_fmids
+   \param flags the delete flags. See emsmdbp_folder_delete for details.
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error.
+*/
+_PUBLIC_ enum mapistore_error emsmdbp_folder_delete_indexing_records(struct mapistore_context *mstore_ctx, uint32_t context_id, char *username, uint64_t fid, uint64_t *deleted_fmids, uint32_t deleted_fmids_count, uint8_t flags)
+{
+        enum mapistore_error    ret;
+        uint8_t                 delete_type_flag;
+
+        delete_type_flag = (flags & DELETE_HARD_DELETE) ? MAPISTORE_PERMANENT_DELETE : MAPISTORE_SOFT_DELETE;
+        ret = mapistore_indexing_record_del_fid(mstore_ctx, context_id, username, fid, delete_type_flag);
+        MAPISTORE_RETVAL_IF(ret != MAPISTORE_SUCCESS, ret, NULL);
+
+        return mapistore_indexing_record_del_fmids(mstore_ctx, context_id, username,
+                                                   deleted_fmids_count, deleted_fmids,
+                                                   delete_type_flag);
+}
+
+/**
+   \details Delete a folder.
+
+   \param emsmdbp_ctx pointer to the emsmdbp context
+   \param parent_folder the parent folder
+   \param fid the folder identifier to delete from parent_folder
+   \param flags the delete flags.
+
+   Possible values for flags are:
+   -# DEL_MESSAGES Delete all the messages in the folder
+   -# DEL_FOLDERS Delete the subfolder and all of its subfolders
+   -# DELETE_HARD_DELETE Hard delete the folder
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error.
+*/
+_PUBLIC_ enum mapistore_error emsmdbp_folder_delete(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *parent_folder, uint64_t fid, uint8_t flags)
+{
+	enum mapistore_error	ret;
+	enum MAPISTATUS		retval;
+	TALLOC_CTX		*mem_ctx;
+	bool			mailboxstore;
+	uint32_t		context_id, deleted_fmids_count;
+	void			*subfolder;
+	char			*mapistoreURL;
+	uint64_t		*deleted_fmids;
+	uint64_t		parent_fid;
+
+	mem_ctx = talloc_new(NULL);
+	MAPISTORE_RETVAL_IF(!mem_ctx, MAPISTORE_ERR_NO_MEMORY, NULL);
+
+	/* Check if it is a special folder */
+	if (oxosfld_is_special_folder(emsmdbp_ctx, fid)) {
+		OC_DEBUG(1, "Attempt to delete special folder: 0x%"PRIx64, fid);
+		ret = MAPISTORE_ERR_DENIED;
+		goto end;
+	}
+
+	mailboxstore = emsmdbp_is_mailboxstore(parent_folder);
+	if (emsmdbp_is_mapistore(parent_folder)) {	/* fid is not a mapistore root */
+		OC_DEBUG(3, "Deleting mapistore folder\n");
+		/* handled by mapistore */
+		context_id = emsmdbp_get_contextID(parent_folder);
+
+		ret = mapistore_folder_open_folder(emsmdbp_ctx->mstore_ctx, context_id, parent_folder->backend_object, mem_ctx, fid, &subfolder);
+		if (ret != MAPISTORE_SUCCESS) {
+			goto end;
+		}
+
+		ret = mapistore_folder_delete(emsmdbp_ctx->mstore_ctx, context_id, subfolder, flags, mem_ctx, &deleted_fmids, &deleted_fmids_count);
+		if (ret != MAPISTORE_SUCCESS) {
+			goto end;
+		}
+
+		/* Update indexing entries */
+		ret = emsmdbp_deferred_delete_indexing_records(emsmdbp_ctx, context_id,
+							       emsmdbp_get_owner(parent_folder),
+							       fid, deleted_fmids, deleted_fmids_count,
+							       flags);
+		if (ret != MAPISTORE_SUCCESS) {
+			goto end;
+		}
 	}
 	else {
 		retval = openchangedb_get_mapistoreURI(mem_ctx, emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, fid, &mapistoreURL, mailboxstore);
@@ -1771,13 +2421,12 @@ _PUBLIC_ enum mapistore_error emsmdbp_folder_delete(struct emsmdbp_context *emsm
 				goto end;
 			}
 
+			/* Update indexing entries, before the context is released */
+			ret = emsmdbp_deferred_delete_indexing_records(emsmdbp_ctx, context_id,
+								       emsmdbp_get_owner(parent_folder),
+								       fid, deleted_fmids, deleted_fmids_count,
+								       flags);
 			mapistore_del_context(emsmdbp_ctx->mstore_ctx, context_id);
-
-			/* Update indexing entries */
-			ret = emsmdbp_folder_delete_indexing_records(emsmdbp_ctx->mstore_ctx, context_id,
-								     emsmdbp_get_owner(parent_folder),
-								     fid, deleted_fmids, deleted_fmids_count,
-								     flags);
 			if (ret != MAPISTORE_SUCCESS) {
 				goto end;
 			}
@@ -1788,7 +2437,24 @@ _PUBLIC_ enum mapistore_error emsmdbp_folder_delete(struct emsmdbp_context *emsm
 			ret = MAPISTORE_ERR_NOT_FOUND;
 			goto end;
 		}
+
+		/* The mailbox must be verified again on next logon */
+		if (mailboxstore) {
+			emsmdbp_logon_record_invalidate(emsmdbp_ctx, emsmdbp_ctx->username);
+			emsmdbp_mailbox_provision_invalidate(emsmdbp_ctx, emsmdbp_ctx->username);
+		}
+	}
+
+	emsmdbp_folder_cache_reset(emsmdbp_ctx);
+	parent_fid = (parent_folder->type == EMSMDBP_OBJECT_MAILBOX) ? parent_folder->object.mailbox->folderID
+								     : parent_folder->object.folder->folderID;
+	emsmdbp_folder_update_recursive_counts(emsmdbp_ctx, parent_folder, parent_fid, fid, -1, true);
+	if (mailboxstore) {
+		openchangedb_clear_recursive_folder_counts(emsmdbp_ctx->oc_ctx, emsmdbp_get_owner(parent_folder), 1, &fid);
+		openchangedb_clear_hierarchy_change_numbers(emsmdbp_ctx->oc_ctx, emsmdbp_get_owner(parent_folder), 1, &fid);
 	}
+	emsmdbp_folder_hierarchy_changed(emsmdbp_ctx, parent_folder, parent_fid);
+	mapistore_tombstones_folder_reset(emsmdbp_ctx->mstore_ctx, emsmdbp_get_owner(parent_folder), fid);
 
 	ret = MAPISTORE_SUCCESS;
 
@@ -1945,7 +2611,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_table_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_TABLE;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_TABLE);
 	object->object.table->prop_count = 0;
 	object->object.table->properties = NULL;
 	object->object.table->numerator = 0;
@@ -1954,10 +2620,365 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_table_init(TALLOC_CTX *mem_ctx,
 	object->object.table->restricted = false;
 	object->object.table->flags = 0;
 	object->object.table->subscription = false;
+	object->object.table->row_cache = NULL;
 
 	return object;
 }
 
+/**
+   \details Drop the rows cached for a table object
+
+   This must be called whenever the column set, the sort order or the
+   restriction of the table change.
+
+   \param table pointer to the table object
+ */
+_PUBLIC_ void emsmdbp_object_table_cache_reset(struct emsmdbp_object_table *table)
+{
+	if (!table) return;
+
+	talloc_free(table->row_cache);
+	table->row_cache = NULL;
+}
+
+/**
+   \details Read the instance key of a table row
+
+   \param mem_ctx pointer to the memory context of the key
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param row_id the position of the row
+   \param instance_key pointer to the key to fill
+
+   \return true if the row was read and has an instance key, otherwise
+   false
+ */
+static bool emsmdbp_object_table_row_instance_key(TALLOC_CTX *mem_ctx,
+						  struct emsmdbp_context *emsmdbp_ctx,
+						  struct emsmdbp_object *table_object,
+						  uint32_t row_id,
+						  struct Binary_r *instance_key)
+{
+	struct emsmdbp_object_table	*table = table_object->object.table;
+	const struct Binary_r		*bin;
+	enum MAPISTATUS			*retvals;
+	void				**data_pointers;
+	uint32_t			i;
+	bool				ret = false;
+
+	for (i = 0; i < table->prop_count; i++) {
+		if (table->properties[i] == PidTagInstanceKey) break;
+	}
+	if (i == table->prop_count || row_id >= table->denominator) {
+		return false;
+	}
+
+	data_pointers = emsmdbp_object_table_get_row_props(mem_ctx, emsmdbp_ctx, table_object, row_id,
+							   MAPISTORE_PREFILTERED_QUERY, &retvals);
+	if (!data_pointers) {
+		return false;
+	}
+	if (retvals[i] == MAPI_E_SUCCESS && data_pointers[i]) {
+		bin = (const struct Binary_r *) data_pointers[i];
+		instance_key->cb = bin->cb;
+		instance_key->lpb = talloc_memdup(mem_ctx, bin->lpb, bin->cb);
+		ret = (bin->cb && instance_key->lpb);
+	}
+	talloc_free(retvals);
+	talloc_free(data_pointers);
+
+	return ret;
+}
+
+/**
+   \details Create a bookmark on a table row
+
+   The bookmark blob returned to the client is the little-endian
+   identifier of the bookmark within the table object. When the
+   column set includes PidTagInstanceKey, the key of the row is kept
+   so the bookmark follows the row if rows are added or removed
+   before it.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param row_id the position of the bookmarked row
+   \param bookmark pointer to the SBinary_short to fill
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_bookmark_create(struct emsmdbp_context *emsmdbp_ctx,
+							      struct emsmdbp_object *table_object,
+							      uint32_t row_id, struct SBinary_short *bookmark)
+{
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_table_bookmark	*el;
+
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!table_object || table_object->type != EMSMDBP_OBJECT_TABLE, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!bookmark, MAPI_E_INVALID_PARAMETER, NULL);
+
+	table = table_object->object.table;
+	el = talloc_zero(table, struct emsmdbp_table_bookmark);
+	OPENCHANGE_RETVAL_IF(!el, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	bookmark->lpb = talloc_array(el, uint8_t, 4);
+	OPENCHANGE_RETVAL_IF(!bookmark->lpb, MAPI_E_NOT_ENOUGH_MEMORY, el);
+	bookmark->cb = 4;
+
+	el->id = ++table->bookmark_id;
+	el->row_id = row_id;
+	/* Positions of categorized views are their own, not rows of the backend */
+	if (!table->categories
+	    && !emsmdbp_object_table_row_instance_key(el, emsmdbp_ctx, table_object, row_id, &el->instance_key)) {
+		el->instance_key.cb = 0;
+		el->instance_key.lpb = NULL;
+	}
+	DLIST_ADD(table->bookmarks, el);
+
+	bookmark->lpb[0] = el->id & 0xff;
+	bookmark->lpb[1] = (el->id >> 8) & 0xff;
+	bookmark->lpb[2] = (el->id >> 16) & 0xff;
+	bookmark->lpb[3] = (el->id >> 24) & 0xff;
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Tell whether a table row holds the instance key of a bookmark
+ */
+static bool emsmdbp_object_table_bookmark_match(TALLOC_CTX *mem_ctx,
+						struct emsmdbp_context *emsmdbp_ctx,
+						struct emsmdbp_object *table_object,
+						struct emsmdbp_table_bookmark *bookmark,
+						uint32_t row_id)
+{
+	struct Binary_r	key;
+	bool		ret;
+
+	ret = emsmdbp_object_table_row_instance_key(mem_ctx, emsmdbp_ctx, table_object, row_id, &key)
+		&& key.cb == bookmark->instance_key.cb
+		&& memcmp(key.lpb, bookmark->instance_key.lpb, key.cb) == 0;
+	talloc_free_children(mem_ctx);
+
+	return ret;
+}
+
+/**
+   \details Find the current position of a bookmarked row
+
+   Bookmarks holding an instance key are checked against the row at
+   their position and, when the row moved, the table is searched for
+   the key. Bookmarks without a key only rely on their position.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param bookmark pointer to the bookmark
+   \param row_id pointer to the position of the row, or to the
+   position it used to have if it is no longer visible
+
+   \return true if the bookmarked row is still in the table, otherwise
+   false
+ */
+_PUBLIC_ bool emsmdbp_object_table_bookmark_locate(struct emsmdbp_context *emsmdbp_ctx,
+						   struct emsmdbp_object *table_object,
+						   struct emsmdbp_table_bookmark *bookmark,
+						   uint32_t *row_id)
+{
+	struct emsmdbp_object_table	*table = table_object->object.table;
+	TALLOC_CTX			*mem_ctx;
+	uint32_t			i;
+	bool				found;
+
+	if (!bookmark->instance_key.cb) {
+		if (bookmark->row_id < table->denominator) {
+			*row_id = bookmark->row_id;
+			return true;
+		}
+		*row_id = table->denominator;
+		return false;
+	}
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) {
+		*row_id = MIN(bookmark->row_id, table->denominator);
+		return false;
+	}
+
+	/* Most of the time the row did not move */
+	*row_id = bookmark->row_id;
+	found = emsmdbp_object_table_bookmark_match(mem_ctx, emsmdbp_ctx, table_object, bookmark, *row_id);
+	for (i = 0; i < table->denominator && !found; i++) {
+		if (i == bookmark->row_id) continue;
+		*row_id = i;
+		found = emsmdbp_object_table_bookmark_match(mem_ctx, emsmdbp_ctx, table_object, bookmark, i);
+	}
+	talloc_free(mem_ctx);
+
+	if (found) {
+		bookmark->row_id = *row_id;
+		return true;
+	}
+
+	/* The rows after the removed one moved up to its position */
+	*row_id = MIN(bookmark->row_id, table->denominator);
+	return false;
+}
+
+/**
+   \details Retrieve the bookmark matching a bookmark blob
+
+   \param table pointer to the table object
+   \param bookmark pointer to the bookmark blob sent by the client
+
+   \return pointer to the bookmark on success, otherwise NULL
+ */
+_PUBLIC_ struct emsmdbp_table_bookmark *emsmdbp_object_table_bookmark_find(struct emsmdbp_object_table *table, const struct SBinary_short *bookmark)
+{
+	struct emsmdbp_table_bookmark	*el;
+	uint32_t			id;
+
+	if (!table || !bookmark || bookmark->cb != 4 || !bookmark->lpb) {
+		return NULL;
+	}
+
+	id = bookmark->lpb[0] | (bookmark->lpb[1] << 8) | (bookmark->lpb[2] << 16) | ((uint32_t)bookmark->lpb[3] << 24);
+	for (el = table->bookmarks; el; el = el->next) {
+		if (el->id == id) {
+			return el;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+   \details Invalidate all the bookmarks of a table object
+
+   This must be called whenever the sort order or the restriction of
+   the table change.
+
+   \param table pointer to the table object
+ */
+_PUBLIC_ void emsmdbp_object_table_bookmarks_reset(struct emsmdbp_object_table *table)
+{
+	struct emsmdbp_table_bookmark	*el;
+
+	if (!table) return;
+
+	while ((el = table->bookmarks)) {
+		DLIST_REMOVE(table->bookmarks, el);
+		talloc_free(el);
+	}
+}
+
+/**
+   \details Check the rows cached for a table before a QueryRows call
+
+   Rows are only cached for tables whose changes are notified to the
+   session, which bumps table_generation. The row count of the backend
+   is compared as well, so rows added or removed by a change whose
+   notification did not arrive yet are not served from the cache.
+   Tables without notification must call
+   emsmdbp_object_table_cache_reset instead.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table pointer to the table object
+   \param row_count the current row count of the table in the backend
+ */
+_PUBLIC_ void emsmdbp_object_table_cache_validate(struct emsmdbp_context *emsmdbp_ctx,
+						  struct emsmdbp_object_table *table, uint32_t row_count)
+{
+	if (!table) return;
+
+	if (table->row_cache && (table->row_cache->generation != emsmdbp_ctx->table_generation ||
+				 table->row_cache->row_count != row_count)) {
+		emsmdbp_object_table_cache_reset(table);
+	}
+	if (!table->row_cache) {
+		table->row_cache = talloc_zero(table, struct emsmdbp_table_row_cache);
+		if (!table->row_cache) {
+			return;
+		}
+		table->row_cache->generation = emsmdbp_ctx->table_generation;
+		table->row_cache->row_count = row_count;
+	}
+}
+
+/**
+   \details Append a cached serialized row to a QueryRows row blob
+
+   \param mem_ctx pointer to the memory context of the row blob
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table pointer to the table object
+   \param row_id the position of the row in the table
+   \param table_row pointer to the row blob to append to
+
+   \return true if the row was found in the cache and appended,
+   otherwise false
+ */
+_PUBLIC_ bool emsmdbp_object_table_cache_fetch(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+					       struct emsmdbp_object_table *table, uint32_t row_id,
+					       DATA_BLOB *table_row)
+{
+	struct emsmdbp_table_row_cache_entry	*entry;
+	uint8_t					*data;
+
+	if (!table || !table->row_cache) return false;
+
+	if (table->row_cache->generation != emsmdbp_ctx->table_generation) {
+		emsmdbp_object_table_cache_reset(table);
+		return false;
+	}
+
+	entry = &table->row_cache->entries[row_id % EMSMDBP_TABLE_ROW_CACHE_SIZE];
+	if (!entry->valid || entry->row_id != row_id) {
+		return false;
+	}
+
+	data = talloc_realloc(mem_ctx, table_row->data, uint8_t, table_row->length + entry->row.length);
+	if (!data) {
+		return false;
+	}
+	memcpy(data + table_row->length, entry->row.data, entry->row.length);
+	table_row->data = data;
+	table_row->length += entry->row.length;
+
+	return true;
+}
+
+/**
+   \details Keep a copy of a serialized row for subsequent QueryRows
+   calls on the same table. Nothing is kept unless
+   emsmdbp_object_table_cache_validate was called first.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table pointer to the table object
+   \param row_id the position of the row in the table
+   \param data pointer to the serialized row
+   \param length length of the serialized row
+ */
+_PUBLIC_ void emsmdbp_object_table_cache_store(struct emsmdbp_context *emsmdbp_ctx,
+					       struct emsmdbp_object_table *table, uint32_t row_id,
+					       const uint8_t *data, size_t length)
+{
+	struct emsmdbp_table_row_cache_entry	*entry;
+
+	if (!table) return;
+
+	if (!table->row_cache) return;
+	if (table->row_cache->generation != emsmdbp_ctx->table_generation) {
+		emsmdbp_object_table_cache_reset(table);
+		return;
+	}
+
+	entry = &table->row_cache->entries[row_id % EMSMDBP_TABLE_ROW_CACHE_SIZE];
+	talloc_free(entry->row.data);
+	entry->row.data = talloc_memdup(table->row_cache, data, length);
+	entry->row.length = entry->row.data ? length : 0;
+	entry->row_id = row_id;
+	entry->valid = (entry->row.data != NULL);
+}
+
 _PUBLIC_ int emsmdbp_object_table_get_available_properties(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *table_object, struct SPropTagArray **propertiesp)
 {
 	int				retval;
@@ -2027,6 +3048,214 @@ _PUBLIC_ int emsmdbp_object_table_get_available_properties(TALLOC_CTX *mem_ctx,
 	return retval;
 }
 
+static void emsmdbp_object_table_row_from_properties(struct emsmdbp_object_table *table, uint32_t num_props,
+						     struct mapistore_property_data *properties,
+						     void **data_pointers, enum MAPISTATUS *retvals)
+{
+	uint32_t	i;
+
+	for (i = 0; i < num_props; i++) {
+		/* Attachment bytes are too large for table rows: clients
+		   read them with OpenStream, as with Exchange */
+		if (table->attach_data_deferred && (table->properties[i] >> 16) == (PidTagAttachDataBinary >> 16)) {
+			data_pointers[i] = NULL;
+			retvals[i] = MAPI_E_NOT_ENOUGH_MEMORY;
+			continue;
+		}
+
+		data_pointers[i] = properties[i].data;
+
+		if (properties[i].error != MAPISTORE_SUCCESS) {
+			retvals[i] = mapistore_error_to_mapi(properties[i].error);
+		}
+		else {
+			if (properties[i].data == NULL) {
+				retvals[i] = MAPI_E_NOT_FOUND;
+			}
+		}
+	}
+}
+
+/**
+   \details Retrieve the properties of consecutive rows of a table
+
+   For mapistore tables, the rows are fetched with a single
+   mapistore_table_get_rows call. Other tables are read row by row with
+   emsmdbp_object_table_get_row_props.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the table object
+   \param start the position of the first row
+   \param count the number of rows to fetch
+   \param query_type the type of query to perform
+   \param fetchedp pointer to the number of rows returned. Fetching stops
+   at the first row emsmdbp_object_table_get_row_props would fail on.
+
+   \return Allocated array of *fetchedp rows, NULL if no row could be
+   fetched
+ */
+_PUBLIC_ struct emsmdbp_table_row_props *emsmdbp_object_table_get_rows_props(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+									      struct emsmdbp_object *table_object, uint32_t start, uint32_t count,
+									      enum mapistore_query_type query_type, uint32_t *fetchedp)
+{
+	struct emsmdbp_table_row_props	*rows;
+	struct mapistore_property_data	**properties;
+	enum mapistore_error		ret;
+	uint32_t			contextID, i, num_props, fetched = 0;
+
+	*fetchedp = 0;
+	if (!count) return NULL;
+
+	rows = talloc_zero_array(mem_ctx, struct emsmdbp_table_row_props, count);
+	if (!rows) {
+		OC_DEBUG(0, "No more memory");
+		return NULL;
+	}
+
+	if (!emsmdbp_is_mapistore(table_object)) {
+		for (fetched = 0; fetched < count; fetched++) {
+			rows[fetched].data_pointers = emsmdbp_object_table_get_row_props(rows, emsmdbp_ctx, table_object, start + fetched,
+											 query_type, &rows[fetched].retvals);
+			if (!rows[fetched].data_pointers) break;
+		}
+		goto end;
+	}
+
+	num_props = table_object->object.table->prop_count;
+	contextID = emsmdbp_get_contextID(table_object);
+	ret = mapistore_table_get_rows(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object, rows,
+				       query_type, start, count, &properties, &fetched);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(5, "invalid object (likely due to a restriction)\n");
+		fetched = 0;
+		goto end;
+	}
+
+	for (i = 0; i < fetched; i++) {
+		rows[i].data_pointers = talloc_zero_array(rows, void *, num_props);
+		rows[i].retvals = talloc_zero_array(rows, enum MAPISTATUS, num_props);
+		if (!rows[i].data_pointers || !rows[i].retvals) {
+			OC_DEBUG(0, "No more memory");
+			fetched = i;
+			break;
+		}
+		emsmdbp_object_table_row_from_properties(table_object->object.table, num_props, properties[i], rows[i].data_pointers, rows[i].retvals);
+	}
+
+end:
+	if (!fetched) {
+		talloc_free(rows);
+		return NULL;
+	}
+	*fetchedp = fetched;
+
+	return rows;
+}
+
+struct emsmdbp_table_row_match {
+	struct emsmdbp_object_table	*table;
+	void				**data_pointers;
+	enum MAPISTATUS			*retvals;
+};
+
+static enum MAPISTATUS emsmdbp_object_table_row_get_property(void *private_data, enum MAPITAGS proptag, void **data)
+{
+	struct emsmdbp_table_row_match	*row = (struct emsmdbp_table_row_match *)private_data;
+	uint32_t			i;
+
+	for (i = 0; i < row->table->prop_count; i++) {
+		if (row->table->properties[i] == proptag) {
+			OPENCHANGE_RETVAL_IF(row->retvals[i] != MAPI_E_SUCCESS, row->retvals[i], NULL);
+			*data = row->data_pointers[i];
+			return MAPI_E_SUCCESS;
+		}
+	}
+
+	return MAPI_E_NOT_FOUND;
+}
+
+/**
+   \details Tell whether a column of a mapistore folder row in an
+   openchangedb hierarchy table must be read from the folder rather
+   than from openchangedb, where it is not maintained
+ */
+static bool emsmdbp_folder_row_dynamic_property(enum MAPITAGS proptag)
+{
+	switch (proptag) {
+	case PidTagParentFolderId:
+	case PR_CONTENT_COUNT:
+	case PidTagAssociatedContentCount:
+	case PR_CONTENT_UNREAD:
+	case PidTagFolderChildCount:
+	case PR_SUBFOLDERS:
+	case PidTagDeletedCountTotal:
+	case PidTagAccess:
+	case PidTagAccessLevel:
+	case PidTagFolderFlags:
+	case PidTagHierRev:
+	case PidTagLocalCommitTimeMax:
+	case PidTagRights:
+	case PidTagSourceKey:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static enum MAPISTATUS emsmdbp_folder_row_get_dynamic_property(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+							       struct emsmdbp_object *folder_object,
+							       enum MAPITAGS proptag, void **data)
+{
+	struct SPropTagArray	props;
+	void			**local_data_pointers;
+	enum MAPISTATUS		*local_retvals;
+	struct Binary_r		*binr;
+
+	if (proptag == PidTagSourceKey) {
+		emsmdbp_source_key_from_fmid(mem_ctx, emsmdbp_ctx, emsmdbp_get_owner(folder_object),
+					     folder_object->object.folder->folderID, &binr);
+		*data = binr;
+		return MAPI_E_SUCCESS;
+	}
+
+	props.cValues = 1;
+	props.aulPropTag = &proptag;
+
+	local_data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, folder_object, &props, &local_retvals);
+	OPENCHANGE_RETVAL_IF(!local_data_pointers, MAPI_E_NOT_FOUND, NULL);
+	*data = local_data_pointers[0];
+
+	return local_retvals[0];
+}
+
+/**
+   \details Evaluate a compiled restriction against a table row
+
+   Only the properties of the table column set are visible to the
+   restriction, other properties are treated as missing.
+
+   \param table pointer to the table object
+   \param program pointer to the compiled restriction
+   \param data_pointers the row values, as returned by
+   emsmdbp_object_table_get_row_props
+   \param retvals the row retvals
+
+   \return true if the row matches the restriction, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_object_table_row_match(struct emsmdbp_object_table *table,
+					     const struct mapiproxy_restriction *program,
+					     void **data_pointers, enum MAPISTATUS *retvals)
+{
+	struct emsmdbp_table_row_match	row;
+
+	row.table = table;
+	row.data_pointers = data_pointers;
+	row.retvals = retvals;
+
+	return mapiproxy_restriction_match(program, emsmdbp_object_table_row_get_property, &row);
+}
+
 _PUBLIC_ void **emsmdbp_object_table_get_row_props(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *table_object, uint32_t row_id, enum mapistore_query_type query_type, enum MAPISTATUS **retvalsp)
 {
         void				**data_pointers;
@@ -2041,12 +3270,15 @@ _PUBLIC_ void **emsmdbp_object_table_get_row_props(TALLOC_CTX *mem_ctx, struct e
 	uint64_t			parentFolderId;
 	bool				mapistore_folder;
 	void				*odb_ctx;
-	char				*owner;
-	struct Binary_r			*binr;
 
         table = table_object->object.table;
         num_props = table_object->object.table->prop_count;
 
+	/* Search folder rows are read from the member messages */
+	if (table->search) {
+		return emsmdbp_search_get_row_props(mem_ctx, emsmdbp_ctx, table_object, row_id, retvalsp);
+	}
+
 	data_pointers = talloc_zero_array(mem_ctx, void *, num_props);
 	if (!data_pointers) {
 		OC_DEBUG(0, "No more memory");
@@ -2059,24 +3291,24 @@ _PUBLIC_ void **emsmdbp_object_table_get_row_props(TALLOC_CTX *mem_ctx, struct e
 		return NULL;
 	}
 
-	if (emsmdbp_is_mapistore(table_object)) {
+	if (table->ulType == MAPISTORE_RULE_TABLE) {
+		/* Rules live in openchangedb, whatever the folder backend */
+		if (!table->rules || row_id >= table->rules->count) {
+			talloc_free(retvals);
+			talloc_free(data_pointers);
+			return NULL;
+		}
+		for (i = 0; i < num_props; i++) {
+			retvals[i] = mapiproxy_rule_get_property(data_pointers, &table->rules->rules[row_id],
+								 table->properties[i], data_pointers + i);
+		}
+	} else if (emsmdbp_is_mapistore(table_object)) {
 		contextID = emsmdbp_get_contextID(table_object);
 		ret = mapistore_table_get_row(emsmdbp_ctx->mstore_ctx, contextID,
 					      table_object->backend_object, data_pointers,
 					      query_type, row_id, &properties);
 		if (ret == MAPISTORE_SUCCESS) {
-			for (i = 0; i < num_props; i++) {
-				data_pointers[i] = properties[i].data;
-                                        
-				if (properties[i].error != MAPISTORE_SUCCESS) {
-					retvals[i] = mapistore_error_to_mapi(properties[i].error);
-				}
-				else {
-					if (properties[i].data == NULL) {
-						retvals[i] = MAPI_E_NOT_FOUND;
-					}
-				}
-			}
+			emsmdbp_object_table_row_from_properties(table, num_props, properties, data_pointers, retvals);
 		}
 		else {
 			OC_DEBUG(5, "invalid object (likely due to a restriction)\n");
@@ -2159,48 +3391,9 @@ _PUBLIC_ void **emsmdbp_object_table_get_row_props(TALLOC_CTX *mem_ctx, struct e
 		/* read the row properties */
                 retval = MAPI_E_SUCCESS;
 		for (i = 0; retval != MAPI_E_INVALID_OBJECT && i < num_props; i++) {
-			if (mapistore_folder) {
-				/* a hack to avoid fetching dynamic fields from openchange.ldb */
-				switch (table->properties[i]) {
-				case PidTagParentFolderId:
-				case PR_CONTENT_COUNT:
-				case PidTagAssociatedContentCount:
-				case PR_CONTENT_UNREAD:
-				case PidTagFolderChildCount:
-				case PR_SUBFOLDERS:
-				case PidTagDeletedCountTotal:
-				case PidTagAccess:
-				case PidTagAccessLevel:
-				case PidTagFolderFlags:
-				case PidTagHierRev:
-				case PidTagLocalCommitTimeMax:
-				case PidTagRights: {
-					struct SPropTagArray props;
-					void **local_data_pointers;
-					enum MAPISTATUS *local_retvals;
-
-					props.cValues = 1;
-					props.aulPropTag = table->properties + i;
-
-					local_data_pointers = emsmdbp_object_get_properties(data_pointers, emsmdbp_ctx, rowobject, &props, &local_retvals);
-					data_pointers[i] = local_data_pointers[0];
-					retval = local_retvals[0];
-				}
-					break;
-				case PidTagSourceKey:
-					owner = emsmdbp_get_owner(table_object);
-					emsmdbp_source_key_from_fmid(data_pointers, emsmdbp_ctx, owner, rowobject->object.folder->folderID, &binr);
-					data_pointers[i] = binr;
-					retval = MAPI_E_SUCCESS;
-					break;
-				default:
-					retval = openchangedb_table_get_property(data_pointers, emsmdbp_ctx->oc_ctx,
-										 table_object->backend_object,
-										 table->properties[i], 
-										 row_id,
-										 (query_type == MAPISTORE_LIVEFILTERED_QUERY),
-										 data_pointers + i);
-				}
+			if (mapistore_folder && emsmdbp_folder_row_dynamic_property(table->properties[i])) {
+				retval = emsmdbp_folder_row_get_dynamic_property(data_pointers, emsmdbp_ctx, rowobject,
+										 table->properties[i], data_pointers + i);
 			}
 			else {
 				retval = openchangedb_table_get_property(data_pointers, emsmdbp_ctx->oc_ctx,
@@ -2235,6 +3428,101 @@ _PUBLIC_ void **emsmdbp_object_table_get_row_props(TALLOC_CTX *mem_ctx, struct e
 
 
 
+/**
+   \details Fill the rows of a hierarchy table with the Depth flag from
+   the folder tree openchangedb reads at once
+
+   The subfolders of mapistore folders are read from their backend, as
+   emsmdbp_object_table_get_recursive_row_props() does.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb context
+   \param table_object pointer to the hierarchy table object
+   \param datablob pointer to the DATA blob to fill
+   \param properties pointer to the array of properties used to fill a
+   row of the table
+   \param remaining pointer on the remaining rows to process
+   \param count pointer on the number of rows processed to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT or
+   MAPI_E_NOT_IMPLEMENTED when the hierarchy must be walked instead,
+   otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_object_table_get_folder_tree_rows(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+								   struct emsmdbp_object *table_object,
+								   DATA_BLOB *datablob, struct SPropTagArray *properties,
+								   int64_t *remaining, uint32_t *count)
+{
+	TALLOC_CTX				*local_mem_ctx;
+	enum MAPISTATUS				retval;
+	struct emsmdbp_object			*parent_object;
+	struct emsmdbp_object			*folder_object;
+	struct openchangedb_folder_tree_entry	*entries, *entry;
+	uint64_t				fid;
+	uint32_t				entry_count, i, j;
+	uint32_t				skip_depth = UINT32_MAX;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!table_object || table_object->type != EMSMDBP_OBJECT_TABLE, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!properties || !remaining || !count, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(emsmdbp_is_mapistore(table_object), MAPI_E_NO_SUPPORT, NULL);
+	OPENCHANGE_RETVAL_IF(table_object->object.table->restricted, MAPI_E_NO_SUPPORT, NULL);
+
+	parent_object = table_object->parent_object;
+	if (parent_object->type == EMSMDBP_OBJECT_FOLDER) {
+		fid = parent_object->object.folder->folderID;
+	} else if (parent_object->type == EMSMDBP_OBJECT_MAILBOX) {
+		fid = parent_object->object.mailbox->folderID;
+	} else {
+		return MAPI_E_NO_SUPPORT;
+	}
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = openchangedb_get_folder_tree(local_mem_ctx, emsmdbp_ctx->oc_ctx, emsmdbp_get_owner(table_object),
+					      fid, 0, properties, &entry_count, &entries);
+	OPENCHANGE_RETVAL_IF(retval, retval, local_mem_ctx);
+
+	for (i = 0; i < entry_count && *remaining > 0; i++) {
+		entry = entries + i;
+		/* The backend of a mapistore folder owns its subfolders */
+		if (entry->depth > skip_depth) continue;
+		skip_depth = UINT32_MAX;
+
+		folder_object = NULL;
+		if (entry->mapistore
+		    && emsmdbp_object_open_folder_by_fid(local_mem_ctx, emsmdbp_ctx, parent_object,
+							 entry->fid, &folder_object) == MAPI_E_SUCCESS) {
+			for (j = 0; j < properties->cValues; j++) {
+				if (emsmdbp_folder_row_dynamic_property(properties->aulPropTag[j])) {
+					entry->retvals[j] = emsmdbp_folder_row_get_dynamic_property(entry->data, emsmdbp_ctx,
+												    folder_object,
+												    properties->aulPropTag[j],
+												    entry->data + j);
+				}
+			}
+		}
+
+		emsmdbp_fill_table_row_blob(mem_ctx, emsmdbp_ctx, datablob, properties->cValues,
+					    properties->aulPropTag, entry->data, entry->retvals);
+		*remaining = *remaining - 1;
+		*count = *count + 1;
+
+		if (folder_object) {
+			talloc_free(folder_object);
+			skip_depth = entry->depth;
+			emsmdbp_object_table_get_recursive_row_props(mem_ctx, emsmdbp_ctx, parent_object, datablob,
+								     properties, entry->fid, remaining, count);
+		}
+	}
+
+	talloc_free(local_mem_ctx);
+
+	return MAPI_E_SUCCESS;
+}
+
 /**
    \details This function process the hierarchy of folders recursively
    and fill requested rows.
@@ -2353,9 +3641,6 @@ _PUBLIC_ void emsmdbp_fill_table_row_blob(TALLOC_CTX *mem_ctx, struct emsmdbp_co
 {
         uint16_t i;
         uint8_t flagged;
-        enum MAPITAGS property;
-        void *data;
-        uint32_t retval;
 
         flagged = 0;
 
@@ -2365,32 +3650,8 @@ _PUBLIC_ void emsmdbp_fill_table_row_blob(TALLOC_CTX *mem_ctx, struct emsmdbp_co
                 }
         }
 
-        if (flagged) {
-                libmapiserver_push_property(mem_ctx,
-                                            0x0000000b, (const void *)&flagged,
-                                            table_row, 0, 0, 0);
-        }
-        else {
-                libmapiserver_push_property(mem_ctx,
-                                            0x00000000, (const void *)&flagged,
-                                            table_row, 0, 1, 0);
-        }
-
-        for (i = 0; i < num_props; i++) {
-                property = properties[i];
-                retval = retvals[i];
-                if (retval != MAPI_E_SUCCESS) {
-                        property = (property & 0xFFFF0000) + PT_ERROR;
-                        data = &retval;
-                }
-                else {
-                        data = data_pointers[i];
-                }
-
-                libmapiserver_push_property(mem_ctx,
-                                            property, data, table_row,
-                                            flagged?PT_ERROR:0, flagged, 0);
-        }
+	libmapiserver_push_property_row(mem_ctx, table_row, num_props, properties,
+					data_pointers, retvals, NULL, flagged, true);
 }
 
 /**
@@ -2428,7 +3689,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_message_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_MESSAGE;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_MESSAGE);
 	object->object.message->messageID = messageID;
 	object->object.message->read_write = false;
 
@@ -2521,40 +3782,179 @@ static enum MAPISTATUS emsmdbp_fetch_freebusy(TALLOC_CTX *mem_ctx,
 	retval = emsmdbp_object_open_folder_by_fid(local_mem_ctx, emsmdbp_ctx, mailbox, inboxFID, &inbox);
 	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, local_mem_ctx);
 
-	/* retrieve Calendar entry id */
-	props = talloc_zero(mem_ctx, struct SPropTagArray);
-	OPENCHANGE_RETVAL_IF(!props, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
-	props->cValues = 1;
-	props->aulPropTag = talloc_zero(props, enum MAPITAGS);
-	props->aulPropTag[0] = PR_IPM_APPOINTMENT_ENTRYID;
+	/* retrieve Calendar entry id */
+	props = talloc_zero(mem_ctx, struct SPropTagArray);
+	OPENCHANGE_RETVAL_IF(!props, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	props->cValues = 1;
+	props->aulPropTag = talloc_zero(props, enum MAPITAGS);
+	props->aulPropTag[0] = PR_IPM_APPOINTMENT_ENTRYID;
+
+	data_pointers = emsmdbp_object_get_properties(local_mem_ctx, emsmdbp_ctx, inbox, props, &retvals);
+	OPENCHANGE_RETVAL_IF(!data_pointers || retvals[0] != MAPI_E_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+
+	calendarFID = 0;
+	for (i = 0; i < 6; i++) {
+		calendarFID <<= 8;
+		calendarFID |= *(((struct Binary_r *) data_pointers[0])->lpb + (43 - i));
+	}
+	calendarFID <<= 16;
+	calendarFID |= 1;
+
+	/* open user calendar */
+	retval = emsmdbp_object_open_folder_by_fid(local_mem_ctx, emsmdbp_ctx, mailbox, calendarFID, &calendar);
+	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, local_mem_ctx);
+
+	if (!emsmdbp_is_mapistore(calendar)) {
+		OC_DEBUG(5, "[emsmdbp_object]: non-mapistore calendars are not supported for freebusy\n");
+		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_IMPLEMENTED, local_mem_ctx);
+	}
+
+	contextID = emsmdbp_get_contextID(calendar);
+	if (!start_tm && !end_tm) {
+		retval_mapistore = mapistore_folder_fetch_freebusy_summary(emsmdbp_ctx->mstore_ctx, contextID, calendar->backend_object,
+									   username, calendarFID, mem_ctx, fb_props_p);
+	} else {
+		retval_mapistore = mapistore_folder_fetch_freebusy_properties(emsmdbp_ctx->mstore_ctx, contextID, calendar->backend_object, start_tm, end_tm, mem_ctx, fb_props_p);
+	}
+	OPENCHANGE_RETVAL_IF(retval_mapistore != MAPISTORE_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+
+	talloc_free(local_mem_ctx);
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Record a saved message in the free/busy summary of its
+   folder, when the folder is a calendar with a summary
+
+   \param message_object pointer to the saved message object
+ */
+_PUBLIC_ void emsmdbp_freebusy_message_saved(struct emsmdbp_object *message_object)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct emsmdbp_context		*emsmdbp_ctx;
+	struct emsmdbp_object		*folder_object;
+	struct SPropTagArray		*props;
+	void				**data_pointers;
+	enum MAPISTATUS			*retvals = NULL;
+	struct mapistore_freebusy_event	event;
+	enum mapistore_error		ret;
+	char				*owner;
+	uint64_t			folderID;
+
+	if (!message_object || message_object->type != EMSMDBP_OBJECT_MESSAGE) return;
+	folder_object = message_object->parent_object;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	emsmdbp_ctx = message_object->emsmdbp_ctx;
+	owner = emsmdbp_get_owner(folder_object);
+	folderID = folder_object->object.folder->folderID;
+	if (!mapistore_freebusy_summary_exists(emsmdbp_ctx->mstore_ctx, owner, folderID)) return;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	event.mid = message_object->object.message->messageID;
+	ret = MAPISTORE_ERR_NO_MEMORY;
+
+	props = talloc_zero(mem_ctx, struct SPropTagArray);
+	if (!props) goto end;
+	props->cValues = 3;
+	props->aulPropTag = talloc_array(props, enum MAPITAGS, props->cValues);
+	if (!props->aulPropTag) goto end;
+	props->aulPropTag[0] = PidLidAppointmentStartWhole;
+	props->aulPropTag[1] = PidLidAppointmentEndWhole;
+	props->aulPropTag[2] = PidLidBusyStatus;
+
+	data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, message_object, props, &retvals);
+	if (data_pointers && retvals[0] == MAPI_E_SUCCESS && retvals[1] == MAPI_E_SUCCESS && retvals[2] == MAPI_E_SUCCESS) {
+		event.start = *((struct FILETIME *) data_pointers[0]);
+		event.end = *((struct FILETIME *) data_pointers[1]);
+		event.busy_status = *((uint32_t *) data_pointers[2]);
+		ret = mapistore_freebusy_summary_update_event(emsmdbp_ctx->mstore_ctx, owner, folderID, &event);
+	} else {
+		/* not an appointment (anymore) */
+		ret = mapistore_freebusy_summary_delete_events(emsmdbp_ctx->mstore_ctx, owner, folderID, 1, &event.mid);
+	}
+
+end:
+	if (ret != MAPISTORE_SUCCESS) {
+		mapistore_freebusy_summary_invalidate(emsmdbp_ctx->mstore_ctx, owner, folderID);
+	}
+	talloc_free(mem_ctx);
+}
+
+/**
+   \details Remove deleted or moved out messages from the free/busy
+   summary of their folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the folder the messages were in
+   \param count number of message identifiers
+   \param mids array of message identifiers
+ */
+_PUBLIC_ void emsmdbp_freebusy_messages_deleted(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object,
+						uint32_t count, const uint64_t *mids)
+{
+	char		*owner;
+	uint64_t	folderID;
+
+	if (!emsmdbp_ctx || !count || !mids) return;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
 
-	data_pointers = emsmdbp_object_get_properties(local_mem_ctx, emsmdbp_ctx, inbox, props, &retvals);
-	OPENCHANGE_RETVAL_IF(!data_pointers || retvals[0] != MAPI_E_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+	owner = emsmdbp_get_owner(folder_object);
+	folderID = folder_object->object.folder->folderID;
+	if (!mapistore_freebusy_summary_exists(emsmdbp_ctx->mstore_ctx, owner, folderID)) return;
 
-	calendarFID = 0;
-	for (i = 0; i < 6; i++) {
-		calendarFID <<= 8;
-		calendarFID |= *(((struct Binary_r *) data_pointers[0])->lpb + (43 - i));
+	if (mapistore_freebusy_summary_delete_events(emsmdbp_ctx->mstore_ctx, owner, folderID, count, mids) != MAPISTORE_SUCCESS) {
+		mapistore_freebusy_summary_invalidate(emsmdbp_ctx->mstore_ctx, owner, folderID);
 	}
-	calendarFID <<= 16;
-	calendarFID |= 1;
+}
 
-	/* open user calendar */
-	retval = emsmdbp_object_open_folder_by_fid(local_mem_ctx, emsmdbp_ctx, mailbox, calendarFID, &calendar);
-	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, local_mem_ctx);
+/**
+   \details Drop the free/busy summary of a folder which received
+   messages whose properties are not known here
 
-	if (!emsmdbp_is_mapistore(calendar)) {
-		OC_DEBUG(5, "[emsmdbp_object]: non-mapistore calendars are not supported for freebusy\n");
-		OPENCHANGE_RETVAL_ERR(MAPI_E_NOT_IMPLEMENTED, local_mem_ctx);
-	}
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the changed folder
+ */
+_PUBLIC_ void emsmdbp_freebusy_folder_changed(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object)
+{
+	if (!emsmdbp_ctx) return;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
 
-	contextID = emsmdbp_get_contextID(calendar);
-	retval_mapistore = mapistore_folder_fetch_freebusy_properties(emsmdbp_ctx->mstore_ctx, contextID, calendar->backend_object, start_tm, end_tm, mem_ctx, fb_props_p);
-	OPENCHANGE_RETVAL_IF(retval_mapistore != MAPISTORE_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+	mapistore_freebusy_summary_invalidate(emsmdbp_ctx->mstore_ctx, emsmdbp_get_owner(folder_object),
+					      folder_object->object.folder->folderID);
+}
 
-	talloc_free(local_mem_ctx);
+/**
+   \details Record deleted or moved out messages in the deleted
+   messages log of their folder, under a new change number
 
-	return MAPI_E_SUCCESS;
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder_object pointer to the folder the messages were in
+   \param count number of message identifiers
+   \param mids array of message identifiers
+ */
+_PUBLIC_ void emsmdbp_tombstones_messages_deleted(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder_object,
+						  uint32_t count, const uint64_t *mids)
+{
+	char		*owner;
+	uint64_t	folderID;
+	uint64_t	cn;
+
+	if (!emsmdbp_ctx || !count || !mids) return;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) return;
+	if (!mapistore_tombstones_enabled()) return;
+
+	owner = emsmdbp_get_owner(folder_object);
+	folderID = folder_object->object.folder->folderID;
+	if (emsmdbp_change_number(emsmdbp_ctx, owner, &cn) != MAPI_E_SUCCESS
+	    || mapistore_tombstones_add(emsmdbp_ctx->mstore_ctx, owner, folderID, (cn << 16) | 0x0001, count, mids) != MAPISTORE_SUCCESS) {
+		/* a log missing deletions must not be read */
+		OC_DEBUG(3, "unable to log %"PRIu32" deletions in folder 0x%.16"PRIx64"\n", count, folderID);
+		mapistore_tombstones_folder_reset(emsmdbp_ctx->mstore_ctx, owner, folderID);
+	}
 }
 
 static enum MAPISTATUS emsmdbp_object_message_fill_freebusy_properties(struct emsmdbp_object *message_object)
@@ -2671,6 +4071,9 @@ end:
 
 	if (ret == MAPISTORE_SUCCESS) {
 		message_object->object.message->read_write = read_write;
+		if (read_write) {
+			emsmdbp_message_counts_track(emsmdbp_ctx, message_object, false);
+		}
 		*messageP = message_object;
 	}
 
@@ -2735,7 +4138,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_stream_init(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_STREAM;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_STREAM);
 	object->object.stream->property = 0;
 	object->object.stream->needs_commit = false;
 	object->object.stream->stream.buffer.data = NULL;
@@ -2775,7 +4178,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_attachment_init(TALLOC_CTX *mem_c
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_ATTACHMENT;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_ATTACHMENT);
 	object->object.attachment->attachmentID = -1;
 
 	return object;
@@ -2801,7 +4204,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_subscription_init(TALLOC_CTX *mem
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_SUBSCRIPTION;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_SUBSCRIPTION);
 	object->object.subscription->handle = 0;
 
 	return object;
@@ -2829,6 +4232,58 @@ _PUBLIC_ int emsmdbp_object_get_available_properties(TALLOC_CTX *mem_ctx, struct
 	return mapistore_properties_get_available_properties(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, mem_ctx, propertiesp);
 }
 
+/**
+   \details Retrieve in a single openchangedb lookup the folder
+   properties the property getters left aside
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the mailbox owner
+   \param fid the folder identifier
+   \param properties the property tags requested
+   \param indexes the indexes in properties of the tags to retrieve
+   \param count the number of indexes
+   \param data_pointers array of data pointers to fill
+   \param retvals array of status codes to fill
+ */
+static void emsmdbp_object_get_properties_openchangedb(struct emsmdbp_context *emsmdbp_ctx, const char *owner, uint64_t fid,
+						       struct SPropTagArray *properties, const uint32_t *indexes, uint32_t count,
+						       void **data_pointers, enum MAPISTATUS *retvals)
+{
+	struct SPropTagArray	pending;
+	void			**data;
+	enum MAPISTATUS		*pending_retvals;
+	enum MAPISTATUS		retval;
+	uint32_t		i;
+
+	if (!count) return;
+
+	pending.cValues = count;
+	pending.aulPropTag = talloc_array(NULL, enum MAPITAGS, count);
+	data = talloc_zero_array(pending.aulPropTag, void *, count);
+	pending_retvals = talloc_array(pending.aulPropTag, enum MAPISTATUS, count);
+	if (!pending.aulPropTag || !data || !pending_retvals) {
+		for (i = 0; i < count; i++) {
+			retvals[indexes[i]] = MAPI_E_NOT_ENOUGH_MEMORY;
+		}
+		talloc_free(pending.aulPropTag);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		pending.aulPropTag[i] = properties->aulPropTag[indexes[i]];
+	}
+
+	retval = openchangedb_get_folder_properties(data_pointers, emsmdbp_ctx->oc_ctx, owner, &pending, fid, data, pending_retvals);
+	for (i = 0; i < count; i++) {
+		retvals[indexes[i]] = (retval == MAPI_E_SUCCESS) ? pending_retvals[i] : retval;
+		if (retvals[indexes[i]] == MAPI_E_SUCCESS) {
+			data_pointers[indexes[i]] = data[i];
+		}
+	}
+
+	talloc_free(pending.aulPropTag);
+}
+
 static int emsmdbp_object_get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *object, struct SPropTagArray *properties, void **data_pointers, enum MAPISTATUS *retvals)
 {
 	enum MAPISTATUS			retval = MAPI_E_SUCCESS;
@@ -2841,6 +4296,10 @@ static int emsmdbp_object_get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx
 	time_t				unix_time;
 	NTTIME				nt_time;
 	struct FILETIME			*ft;
+	uint32_t			*indexes, count = 0;
+
+	indexes = talloc_array(data_pointers, uint32_t, properties->cValues);
+	OPENCHANGE_RETVAL_IF(!indexes, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 
 	folder = (struct emsmdbp_object_folder *) object->object.folder;
         for (i = 0; i < properties->cValues; i++) {
@@ -2883,11 +4342,17 @@ static int emsmdbp_object_get_properties_systemspecialfolder(TALLOC_CTX *mem_ctx
 			retval = MAPI_E_SUCCESS;
 		}
                 else {
-			retval = openchangedb_get_folder_property(data_pointers, emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, properties->aulPropTag[i], folder->folderID, data_pointers + i);
+			/* Fetched from openchangedb below */
+			indexes[count++] = i;
+			continue;
                 }
 		retvals[i] = retval;
         }
 
+	emsmdbp_object_get_properties_openchangedb(emsmdbp_ctx, emsmdbp_ctx->username, folder->folderID,
+						   properties, indexes, count, data_pointers, retvals);
+	talloc_free(indexes);
+
 	return MAPISTORE_SUCCESS;
 }
 
@@ -3004,10 +4469,38 @@ static int emsmdbp_object_get_properties_mapistore_root(TALLOC_CTX *mem_ctx, str
 	uint8_t				*has_subobj;
 	uint32_t			*folder_flags;
 	uint64_t			*fid;
+	uint32_t			*indexes, count = 0;
+	char				*folder_owner;
+	struct openchangedb_message_counts	counts;
+	enum MAPISTATUS			counts_retval = MAPI_E_NOT_FOUND;
+	uint64_t			*size;
 
 	contextID = emsmdbp_get_contextID(object);
 
+	indexes = talloc_array(data_pointers, uint32_t, properties->cValues);
+	OPENCHANGE_RETVAL_IF(!indexes, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	/* We are not using emsmdbp_ctx->username because we want to impersonate to get the properties
+	   on shared folders */
+	folder_owner = emsmdbp_get_owner(object);
+	if (!folder_owner) {
+		/* Public folder? Then, use logged user */
+		folder_owner = emsmdbp_ctx->username;
+	}
+
 	folder = (struct emsmdbp_object_folder *) object->object.folder;
+
+	/* Message counts and sizes come from the stored counters when
+	   they are maintained */
+	for (i = 0; i < properties->cValues; i++) {
+		if (properties->aulPropTag[i] == PR_CONTENT_COUNT || properties->aulPropTag[i] == PidTagAssociatedContentCount
+		    || properties->aulPropTag[i] == PR_CONTENT_UNREAD || properties->aulPropTag[i] == PidTagMessageSize
+		    || properties->aulPropTag[i] == PidTagMessageSizeExtended) {
+			counts_retval = emsmdbp_message_counts_get_folder(emsmdbp_ctx, object, &counts);
+			break;
+		}
+	}
+
         for (i = 0; i < properties->cValues; i++) {
 		if (properties->aulPropTag[i] == PidTagFolderFlags) {
 			folder_flags = talloc_zero(data_pointers, uint32_t);
@@ -3035,6 +4528,35 @@ static int emsmdbp_object_get_properties_mapistore_root(TALLOC_CTX *mem_ctx, str
 				break;
 			}
 		}
+		else if (counts_retval == MAPI_E_SUCCESS && (properties->aulPropTag[i] == PR_CONTENT_COUNT
+							     || properties->aulPropTag[i] == PidTagAssociatedContentCount
+							     || properties->aulPropTag[i] == PR_CONTENT_UNREAD)) {
+			obj_count = talloc_zero(data_pointers, uint32_t);
+			OPENCHANGE_RETVAL_IF(!obj_count, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+			if (properties->aulPropTag[i] == PR_CONTENT_COUNT) {
+				*obj_count = counts.messages;
+			} else if (properties->aulPropTag[i] == PidTagAssociatedContentCount) {
+				*obj_count = counts.fai;
+			} else {
+				*obj_count = counts.unread;
+			}
+			data_pointers[i] = obj_count;
+			retval = MAPI_E_SUCCESS;
+		}
+		else if (counts_retval == MAPI_E_SUCCESS && properties->aulPropTag[i] == PidTagMessageSize) {
+			obj_count = talloc_zero(data_pointers, uint32_t);
+			OPENCHANGE_RETVAL_IF(!obj_count, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+			*obj_count = (counts.size > UINT32_MAX) ? UINT32_MAX : counts.size;
+			data_pointers[i] = obj_count;
+			retval = MAPI_E_SUCCESS;
+		}
+		else if (counts_retval == MAPI_E_SUCCESS && properties->aulPropTag[i] == PidTagMessageSizeExtended) {
+			size = talloc_zero(data_pointers, uint64_t);
+			OPENCHANGE_RETVAL_IF(!size, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+			*size = counts.size;
+			data_pointers[i] = size;
+			retval = MAPI_E_SUCCESS;
+		}
 		else if (properties->aulPropTag[i] == PR_CONTENT_COUNT) {
 			obj_count = talloc_zero(data_pointers, uint32_t);
 			OPENCHANGE_RETVAL_IF(!obj_count, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
@@ -3115,21 +4637,20 @@ static int emsmdbp_object_get_properties_mapistore_root(TALLOC_CTX *mem_ctx, str
 			}
 		}
 		else {
-			/* We are not using emsmdbp_ctx->username because we want to impersonate to get the properties
-			  on shared folders */
-			owner = emsmdbp_get_owner(object);
-			if (!owner) {
-				/* Public folder? Then, use logged user */
-				owner = emsmdbp_ctx->username;
-			}
 			if (properties->aulPropTag[i] == PidTagHierRev) {
 				properties->aulPropTag[i] = PidTagCreationTime;
 			}
-			retval = openchangedb_get_folder_property(data_pointers, emsmdbp_ctx->oc_ctx, owner, properties->aulPropTag[i], folder->folderID, data_pointers + i);
+			/* Fetched from openchangedb below */
+			indexes[count++] = i;
+			continue;
 		}
 		retvals[i] = retval;
 	}
 
+	emsmdbp_object_get_properties_openchangedb(emsmdbp_ctx, folder_owner, folder->folderID,
+						   properties, indexes, count, data_pointers, retvals);
+	talloc_free(indexes);
+
 	return MAPISTORE_SUCCESS;
 }
 
@@ -3137,6 +4658,10 @@ static int emsmdbp_object_get_properties_mailbox(TALLOC_CTX *mem_ctx, struct ems
 {
 	uint32_t			i;
 	struct SBinary_short		*bin;
+	uint32_t			*indexes, count = 0;
+
+	indexes = talloc_array(data_pointers, uint32_t, properties->cValues);
+	OPENCHANGE_RETVAL_IF(!indexes, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 
 	for (i = 0; i < properties->cValues; i++) {
 		switch (properties->aulPropTag[i]) {
@@ -3168,10 +4693,16 @@ static int emsmdbp_object_get_properties_mailbox(TALLOC_CTX *mem_ctx, struct ems
 			}
 			break;
 		default:
-			retvals[i] = openchangedb_get_folder_property(data_pointers, emsmdbp_ctx->oc_ctx, object->object.mailbox->owner_username, properties->aulPropTag[i], object->object.mailbox->folderID, data_pointers + i);
+			/* Fetched from openchangedb below */
+			indexes[count++] = i;
 		}
 	}
 
+	emsmdbp_object_get_properties_openchangedb(emsmdbp_ctx, object->object.mailbox->owner_username,
+						   object->object.mailbox->folderID,
+						   properties, indexes, count, data_pointers, retvals);
+	talloc_free(indexes);
+
 	return MAPISTORE_SUCCESS;
 }
 
@@ -3212,6 +4743,213 @@ static int emsmdbp_object_get_properties_mapistore(TALLOC_CTX *mem_ctx, struct e
 	return ret;
 }
 
+/**
+   \details Keep properties set on a mapistore message until
+   SaveChangesMessage, replacing the values previously set for the same
+   properties
+
+   \param message_object pointer to the message object
+   \param rowp pointer to the properties to set
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_object_message_defer_properties(struct emsmdbp_object *message_object, struct SRow *rowp)
+{
+	struct SRow		*pending;
+	struct SPropValue	*lpProps;
+	uint32_t		i, j;
+
+	pending = message_object->object.message->pending_props;
+	if (!pending) {
+		pending = talloc_zero(message_object, struct SRow);
+		OPENCHANGE_RETVAL_IF(!pending, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		message_object->object.message->pending_props = pending;
+	}
+
+	lpProps = talloc_realloc(pending, pending->lpProps, struct SPropValue, pending->cValues + rowp->cValues);
+	OPENCHANGE_RETVAL_IF(!lpProps, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	pending->lpProps = lpProps;
+
+	for (i = 0; i < rowp->cValues; i++) {
+		/* The last value wins, whatever the type it was set with */
+		for (j = 0; j < pending->cValues; j++) {
+			if ((pending->lpProps[j].ulPropTag >> 16) == (rowp->lpProps[i].ulPropTag >> 16)) break;
+		}
+		mapi_copy_spropvalues(pending, rowp->lpProps + i, pending->lpProps + j, 1);
+		if (j == pending->cValues) {
+			pending->cValues++;
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details Overlay the properties set on a message but not saved yet
+   on the ones read from its backend
+ */
+static void emsmdbp_object_message_pending_properties(struct emsmdbp_object *message_object, struct SPropTagArray *properties, void **data_pointers, enum MAPISTATUS *retvals)
+{
+	struct SRow	*pending;
+	uint32_t	i, j;
+
+	pending = message_object->object.message->pending_props;
+	for (i = 0; i < properties->cValues; i++) {
+		for (j = 0; j < pending->cValues; j++) {
+			if (pending->lpProps[j].ulPropTag == properties->aulPropTag[i]) break;
+		}
+		if (j == pending->cValues) continue;
+
+		data_pointers[i] = (void *) get_SPropValue_data(&pending->lpProps[j]);
+		if (data_pointers[i]) {
+			(void) talloc_reference(data_pointers, pending);
+			retvals[i] = MAPI_E_SUCCESS;
+		}
+		else {
+			retvals[i] = MAPI_E_NOT_FOUND;
+		}
+	}
+}
+
+/**
+   \details Hand the properties set on a message since it was opened
+   or last saved to its backend, with a single call
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object pointer to the message object
+
+   \return MAPISTORE_SUCCESS on success, otherwise MAPISTORE error
+ */
+_PUBLIC_ enum mapistore_error emsmdbp_object_message_flush_properties(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *message_object)
+{
+	struct SRow		*pending;
+	enum mapistore_error	ret;
+
+	MAPISTORE_RETVAL_IF(!emsmdbp_ctx, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(!message_object, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+	MAPISTORE_RETVAL_IF(message_object->type != EMSMDBP_OBJECT_MESSAGE, MAPISTORE_ERR_INVALID_PARAMETER, NULL);
+
+	pending = message_object->object.message->pending_props;
+	if (!pending) return MAPISTORE_SUCCESS;
+	message_object->object.message->pending_props = NULL;
+
+	ret = MAPISTORE_SUCCESS;
+	if (pending->cValues) {
+		ret = mapistore_properties_set_properties(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(message_object),
+							  message_object->backend_object, pending);
+	}
+	talloc_unlink(message_object, pending);
+
+	return ret;
+}
+
+/* The properties clients read right after opening a message */
+static enum MAPITAGS emsmdbp_message_prefetch_tags[] = {
+	PidTagMessageClass,
+	PidTagMessageFlags,
+	PidTagSubject,
+	PidTagSubjectPrefix,
+	PidTagNormalizedSubject,
+	PidTagImportance,
+	PidTagSensitivity,
+	PidTagPriority,
+	PidTagHasAttachments,
+	PidTagMessageSize,
+	PidTagCreationTime,
+	PidTagLastModificationTime,
+	PidTagMessageDeliveryTime,
+	PidTagClientSubmitTime,
+	PidTagSentRepresentingName,
+	PidTagSenderName,
+	PidTagDisplayTo,
+	PidTagDisplayCc,
+	PidTagInternetMessageId,
+	PidTagChangeKey,
+	PidTagPredecessorChangeList,
+	PidTagConversationTopic,
+	PidTagConversationIndex,
+	PidTagIconIndex,
+	PidTagFlagStatus,
+	PidTagReadReceiptRequested,
+	PidTagInternetCodepage,
+	PidTagMessageLocaleId,
+	PidTagNativeBody
+};
+
+/**
+   \details Read the common properties of a mapistore message with a
+   single backend call and keep them in the message object, so the
+   GetProps following OpenMessage is answered from memory
+
+   The properties are dropped as soon as any ROP which may modify
+   objects is processed, see emsmdbp_ctx->table_generation.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object pointer to the message object
+ */
+_PUBLIC_ void emsmdbp_object_message_prefetch(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *message_object)
+{
+	struct emsmdbp_message_prefetch	*prefetch;
+
+	if (!emsmdbp_ctx || !message_object) return;
+	if (message_object->type != EMSMDBP_OBJECT_MESSAGE) return;
+	if (!emsmdbp_is_mapistore(message_object)) return;
+
+	TALLOC_FREE(message_object->object.message->prefetch);
+
+	prefetch = talloc_zero(message_object, struct emsmdbp_message_prefetch);
+	if (!prefetch) return;
+
+	prefetch->properties.cValues = sizeof (emsmdbp_message_prefetch_tags) / sizeof (emsmdbp_message_prefetch_tags[0]);
+	prefetch->properties.aulPropTag = emsmdbp_message_prefetch_tags;
+	prefetch->data_pointers = emsmdbp_object_get_properties(prefetch, emsmdbp_ctx, message_object,
+								&prefetch->properties, &prefetch->retvals);
+	if (!prefetch->data_pointers) {
+		talloc_free(prefetch);
+		return;
+	}
+	prefetch->generation = emsmdbp_ctx->table_generation;
+
+	message_object->object.message->prefetch = prefetch;
+}
+
+/**
+   \details Answer a property request from the properties read by
+   emsmdbp_object_message_prefetch
+
+   \return true if every requested property was prefetched, otherwise
+   false and the request goes to the backend
+ */
+static bool emsmdbp_object_get_properties_prefetched(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *object, struct SPropTagArray *properties, void **data_pointers, enum MAPISTATUS *retvals)
+{
+	struct emsmdbp_message_prefetch	*prefetch;
+	uint32_t			i, j;
+
+	prefetch = object->object.message->prefetch;
+	if (prefetch->generation != emsmdbp_ctx->table_generation) {
+		TALLOC_FREE(object->object.message->prefetch);
+		return false;
+	}
+
+	for (i = 0; i < properties->cValues; i++) {
+		for (j = 0; j < prefetch->properties.cValues; j++) {
+			if (prefetch->properties.aulPropTag[j] == properties->aulPropTag[i]) break;
+		}
+		if (j == prefetch->properties.cValues) return false;
+	}
+
+	for (i = 0; i < properties->cValues; i++) {
+		for (j = 0; prefetch->properties.aulPropTag[j] != properties->aulPropTag[i]; j++);
+		retvals[i] = prefetch->retvals[j];
+		if (prefetch->data_pointers[j]) {
+			data_pointers[i] = prefetch->data_pointers[j];
+			(void) talloc_reference(data_pointers, prefetch->data_pointers[j]);
+		}
+	}
+
+	return true;
+}
+
 _PUBLIC_ void **emsmdbp_object_get_properties(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *object, struct SPropTagArray *properties, enum MAPISTATUS **retvalsp)
 {
         void		**data_pointers;
@@ -3225,6 +4963,11 @@ _PUBLIC_ void **emsmdbp_object_get_properties(TALLOC_CTX *mem_ctx, struct emsmdb
         retvals = talloc_array(mem_ctx, enum MAPISTATUS, properties->cValues);
         memset(retvals, 0, sizeof(enum MAPISTATUS) * properties->cValues);
 
+	if (object && object->type == EMSMDBP_OBJECT_MESSAGE && object->object.message->prefetch &&
+	    emsmdbp_object_get_properties_prefetched(emsmdbp_ctx, object, properties, data_pointers, retvals)) {
+		goto end;
+	}
+
 	/* Temporary hack: If this is a mapistore root container
 	 * (e.g. Inbox, Calendar etc.), directly stored under
 	 * IPM.Subtree, then fetch properties from openchange
@@ -3279,6 +5022,9 @@ end:
 		talloc_free(retvals);
 		retvals = NULL;
 	}
+	else if (object && object->type == EMSMDBP_OBJECT_MESSAGE && object->object.message->pending_props) {
+		emsmdbp_object_message_pending_properties(object, properties, data_pointers, retvals);
+	}
 
 	if (retvalsp) {
 		*retvalsp = retvals;
@@ -3501,11 +5247,19 @@ _PUBLIC_ int emsmdbp_object_set_properties(struct emsmdbp_context *emsmdbp_ctx,
 			}
 			break;
 		case true:
+			if (object->type == EMSMDBP_OBJECT_MESSAGE &&
+			    lpcfg_parm_bool(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "defer_message_properties", false)) {
+				return emsmdbp_object_message_defer_properties(object, rowp);
+			}
 			mapistore_properties_set_properties(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, rowp);
 			break;
 		}
 	}
 
+	if (object->type == EMSMDBP_OBJECT_FOLDER) {
+		emsmdbp_folder_hierarchy_changed(emsmdbp_ctx, object, object->object.folder->folderID);
+	}
+
 	return MAPI_E_SUCCESS;
 }
 
@@ -3520,9 +5274,6 @@ _PUBLIC_ void emsmdbp_fill_row_blob(TALLOC_CTX *mem_ctx,
 {
         uint16_t i;
         uint8_t flagged;
-        enum MAPITAGS property;
-        void *data;
-        uint32_t retval;
 
         flagged = 0;
         for (i = 0; !flagged && i < properties->cValues; i++) {
@@ -3532,20 +5283,8 @@ _PUBLIC_ void emsmdbp_fill_row_blob(TALLOC_CTX *mem_ctx,
         }
 	*layout = flagged;
 
-        for (i = 0; i < properties->cValues; i++) {
-                retval = retvals[i];
-                if (retval != MAPI_E_SUCCESS) {
-                        property = (properties->aulPropTag[i] & 0xFFFF0000) + PT_ERROR;
-                        data = &retval;
-                }
-                else {
-                        property = properties->aulPropTag[i];
-                        data = data_pointers[i];
-                }
-                libmapiserver_push_property(mem_ctx,
-                                            property, data, property_row,
-                                            flagged ? PT_ERROR : 0, flagged, untyped_status[i]);
-        }
+	libmapiserver_push_property_row(mem_ctx, property_row, properties->cValues, properties->aulPropTag,
+					data_pointers, retvals, untyped_status, flagged, false);
 }
 
 _PUBLIC_ struct emsmdbp_stream_data *emsmdbp_stream_data_from_value(TALLOC_CTX *mem_ctx, enum MAPITAGS prop_tag, void *value, bool read_write)
@@ -3559,22 +5298,24 @@ _PUBLIC_ struct emsmdbp_stream_data *emsmdbp_stream_data_from_value(TALLOC_CTX *
 	prop_type = prop_tag & 0xffff;
 	if (prop_type == PT_STRING8) {
 		stream_data->data.length = strlen(value) + 1;
-		stream_data->data.data = value;
-                (void) talloc_reference(stream_data, stream_data->data.data);
+		stream_data->data.data = talloc_memdup(stream_data, value, stream_data->data.length);
+		if (!stream_data->data.data) {
+			talloc_free(stream_data);
+			return NULL;
+		}
 	}
 	else if (prop_type == PT_UNICODE) {
-		stream_data->data.length = strlen_m_ext((char *) value, CH_UTF8, CH_UTF16LE) * 2;
-		stream_data->data.data = talloc_array(stream_data, uint8_t, stream_data->data.length + 2);
-		convert_string(CH_UTF8, CH_UTF16LE,
-			       value, strlen(value),
-			       stream_data->data.data, stream_data->data.length,
-			       &converted_size);
-		memset(stream_data->data.data + stream_data->data.length, 0, 2 * sizeof(uint8_t));
+		/* the NUL terminator follows the data */
+		stream_data->data.data = mapi_utf16_push_talloc(stream_data, (const char *) value, &converted_size);
+		if (!stream_data->data.data) {
+			talloc_free(stream_data);
+			return NULL;
+		}
+		stream_data->data.length = converted_size - 2;
 	}
 	else if (prop_type == PT_BINARY) {
 		stream_data->data.length = ((struct Binary_r *) value)->cb;
 		stream_data->data.data = talloc_memdup(stream_data, ((struct Binary_r *) value)->lpb, stream_data->data.length);
-                (void) talloc_reference(stream_data, value);
 	}
 	else {
 		talloc_free(stream_data);
@@ -3600,31 +5341,195 @@ _PUBLIC_ DATA_BLOB emsmdbp_stream_read_buffer(struct emsmdbp_stream *stream, uin
 	return buffer;
 }
 
-_PUBLIC_ void emsmdbp_stream_write_buffer(TALLOC_CTX *mem_ctx, struct emsmdbp_stream *stream, DATA_BLOB new_buffer)
+static int emsmdbp_stream_spill_destructor(struct emsmdbp_stream_spill *spill)
 {
-	size_t new_position;
-	uint32_t old_length;
-	uint8_t *old_data;
+	if (spill->map) {
+		munmap(spill->map, spill->size);
+	}
+	if (spill->fd != -1) {
+		close(spill->fd);
+	}
+	return 0;
+}
 
-	new_position = stream->position + new_buffer.length;
-	if (new_position >= stream->buffer.length) {
-		old_length = stream->buffer.length;
-		stream->buffer.length = new_position;
-		if (stream->buffer.data) {
-			old_data = stream->buffer.data;
-			stream->buffer.data = talloc_realloc(mem_ctx, stream->buffer.data, uint8_t, stream->buffer.length);
-			if (!stream->buffer.data) {
-				OC_DEBUG(5, "WARNING: [bug] lost buffer pointer (data = NULL)\n");
-				stream->buffer.data = talloc_array(mem_ctx, uint8_t, stream->buffer.length);
-				memcpy(stream->buffer.data, old_data, old_length);
+/**
+   \details Resize the temporary file backing a stream, creating it on
+   first use, and map it
+
+   \param mem_ctx pointer to the memory context the file is attached to
+   \param stream pointer to the stream
+   \param capacity the new size of the file
+
+   The file is unlinked as soon as it is created, so it disappears with
+   the stream or the process.
+
+   \return true on success, otherwise false
+ */
+static bool emsmdbp_stream_spill_resize(TALLOC_CTX *mem_ctx, struct emsmdbp_stream *stream, size_t capacity)
+{
+	struct emsmdbp_stream_spill	*spill;
+	char				*path;
+	void				*map;
+
+	spill = stream->spill;
+	if (!spill) {
+		spill = talloc_zero(mem_ctx, struct emsmdbp_stream_spill);
+		if (!spill) return false;
+		spill->fd = -1;
+		talloc_set_destructor(spill, emsmdbp_stream_spill_destructor);
+
+		path = talloc_asprintf(spill, "%s/emsmdb-stream-XXXXXX", stream->spill_dir ? stream->spill_dir : "/tmp");
+		if (!path) {
+			talloc_free(spill);
+			return false;
+		}
+		spill->fd = mkstemp(path);
+		if (spill->fd == -1) {
+			OC_DEBUG(1, "Unable to create stream spill file %s: %s", path, strerror(errno));
+			talloc_free(spill);
+			return false;
+		}
+		unlink(path);
+		talloc_free(path);
+	}
+
+	if (ftruncate(spill->fd, capacity) == -1) {
+		OC_DEBUG(1, "Unable to grow stream spill file to %zu bytes: %s", capacity, strerror(errno));
+		goto fail;
+	}
+
+	/* The file keeps the content, the old mapping can go first */
+	if (spill->map) {
+		munmap(spill->map, spill->size);
+		spill->map = NULL;
+	}
+	map = mmap(NULL, capacity, PROT_READ|PROT_WRITE, MAP_SHARED, spill->fd, 0);
+	if (map == MAP_FAILED) {
+		OC_DEBUG(1, "Unable to map stream spill file: %s", strerror(errno));
+		goto fail;
+	}
+	spill->map = (uint8_t *) map;
+	spill->size = capacity;
+	stream->spill = spill;
+
+	return true;
+
+fail:
+	/* Only a file that never held the stream can be dropped */
+	if (!stream->spill) {
+		talloc_free(spill);
+	}
+	return false;
+}
+
+/**
+   \details Make room in a stream buffer for at least length bytes
+
+   \param mem_ctx pointer to the memory context the buffer is allocated
+   from
+   \param stream pointer to the stream
+   \param length the number of bytes the buffer must hold
+
+   The capacity grows geometrically, so a stream written in many small
+   chunks is only copied a logarithmic number of times. A buffer set by
+   the caller (capacity 0) is copied to one owned by the stream and left
+   to its owner. Past stream->spill_size the buffer moves to a
+   temporary file.
+
+   \return true on success, otherwise false
+ */
+static bool emsmdbp_stream_reserve(TALLOC_CTX *mem_ctx, struct emsmdbp_stream *stream, size_t length)
+{
+	size_t	capacity;
+	uint8_t	*data;
+
+	length += EMSMDBP_STREAM_SLACK;
+	if (length <= stream->capacity) return true;
+
+	capacity = stream->capacity ? stream->capacity : EMSMDBP_STREAM_MIN_CAPACITY;
+	while (capacity < length) {
+		capacity *= 2;
+	}
+
+	if (stream->spill || (stream->spill_size && capacity > stream->spill_size)) {
+		if (!stream->spill) {
+			data = stream->buffer.data;
+			if (emsmdbp_stream_spill_resize(mem_ctx, stream, capacity)) {
+				if (stream->buffer.length) {
+					memcpy(stream->spill->map, data, stream->buffer.length);
+				}
+				if (stream->capacity) {
+					talloc_free(data);
+				}
+				stream->buffer.data = stream->spill->map;
+				stream->capacity = capacity;
+				return true;
 			}
+			/* Keep the stream in memory */
 		}
 		else {
-			stream->buffer.data = talloc_array(mem_ctx, uint8_t, stream->buffer.length);
+			if (!emsmdbp_stream_spill_resize(mem_ctx, stream, capacity)) {
+				/* The mapping may be gone with the failure */
+				stream->buffer.data = stream->spill->map;
+				if (!stream->buffer.data) {
+					stream->buffer.length = 0;
+					stream->position = 0;
+					stream->capacity = 0;
+				}
+				return false;
+			}
+			stream->buffer.data = stream->spill->map;
+			stream->capacity = capacity;
+			return true;
+		}
+	}
+
+	if (stream->capacity) {
+		data = talloc_realloc(mem_ctx, stream->buffer.data, uint8_t, capacity);
+	}
+	else {
+		data = talloc_array(mem_ctx, uint8_t, capacity);
+		if (data && stream->buffer.length) {
+			memcpy(data, stream->buffer.data, stream->buffer.length);
 		}
 	}
+	if (!data) {
+		OC_DEBUG(1, "Unable to grow stream buffer to %zu bytes", capacity);
+		return false;
+	}
+	stream->buffer.data = data;
+	stream->capacity = capacity;
+
+	return true;
+}
+
+/**
+   \details Write data to a stream at its current position
+
+   \param mem_ctx pointer to the memory context the stream buffer is
+   allocated from
+   \param stream pointer to the stream
+   \param new_buffer the data to write
+
+   The buffer is always followed by EMSMDBP_STREAM_SLACK zero bytes so
+   its content can be used as a string property as is.
+ */
+_PUBLIC_ void emsmdbp_stream_write_buffer(TALLOC_CTX *mem_ctx, struct emsmdbp_stream *stream, DATA_BLOB new_buffer)
+{
+	size_t new_position;
+
+	new_position = stream->position + new_buffer.length;
+	if (!emsmdbp_stream_reserve(mem_ctx, stream, new_position)) {
+		OC_DEBUG(0, "Unable to write %zu bytes to stream at position %zu",
+			 new_buffer.length, stream->position);
+		return;
+	}
 
 	memcpy(stream->buffer.data + stream->position, new_buffer.data, new_buffer.length);
+	if (new_position > stream->buffer.length) {
+		stream->buffer.length = new_position;
+	}
+	memset(stream->buffer.data + stream->buffer.length, 0, EMSMDBP_STREAM_SLACK);
 	stream->position = new_position;
 }
 
@@ -3675,7 +5580,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_synccontext_init(TALLOC_CTX *mem_
 		return NULL;
 	}
 
-	synccontext_object->type = EMSMDBP_OBJECT_SYNCCONTEXT;
+	emsmdbp_object_set_type(synccontext_object, EMSMDBP_OBJECT_SYNCCONTEXT);
 
 	(void) talloc_reference(synccontext_object->object.synccontext, parent_object);
         synccontext_object->object.synccontext->state_property = 0;
@@ -3688,8 +5593,6 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_synccontext_init(TALLOC_CTX *mem_
 	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, NULL, &synccontext_object->object.synccontext->cnset_seen->repl.guid);
 	synccontext_object->object.synccontext->cnset_seen->ranges = talloc_zero(synccontext_object->object.synccontext->cnset_seen, struct globset_range);
 	synccontext_object->object.synccontext->cnset_seen->range_count = 1;
-	synccontext_object->object.synccontext->cnset_seen->ranges->next = NULL;
-	synccontext_object->object.synccontext->cnset_seen->ranges->prev = synccontext_object->object.synccontext->cnset_seen->ranges;
 	synccontext_object->object.synccontext->cnset_seen->ranges->low = 0xffffffffffffffffLL;
 	synccontext_object->object.synccontext->cnset_seen->ranges->high = 0x0;
 
@@ -3725,7 +5628,7 @@ _PUBLIC_ struct emsmdbp_object *emsmdbp_object_ftcontext_init(TALLOC_CTX *mem_ct
 		return NULL;
 	}
 
-	object->type = EMSMDBP_OBJECT_FTCONTEXT;
+	emsmdbp_object_set_type(object, EMSMDBP_OBJECT_FTCONTEXT);
 
 	return object;
 }
@@ -0,0 +1,217 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_propset.c
+
+   \brief Prepared property sets
+
+   Clients ask for the same few tag arrays over and over, on every
+   message they open. Before the properties can be fetched, untyped
+   tags have to be given their type, which for named properties means
+   a lookup in the named properties backend. A prepared property set
+   keeps the result of that resolution, along with what the reply
+   needs to know about each tag, and is kept on the session so that
+   the next request with the same tag array reuses it.
+
+   Sets holding a named property which is not mapped yet are not kept:
+   the client may map it later with GetIDsFromNames.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Number of prepared sets kept on a session */
+#define	EMSMDBP_PROPSET_CACHE_SIZE	32
+
+static uint32_t emsmdbp_propset_hash(uint16_t count, const enum MAPITAGS *tags)
+{
+	uint32_t	hash = 2166136261U;
+	uint16_t	i;
+
+	for (i = 0; i < count; i++) {
+		hash = (hash ^ tags[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+
+/**
+   \details Resolve a tag array into a prepared property set
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param count the number of tags
+   \param tags the tags as sent by the client
+   \param cacheablep pointer to the boolean telling whether the set may
+   be kept on the session
+
+   \return the prepared property set on success, otherwise NULL
+ */
+static struct emsmdbp_propset *emsmdbp_propset_prepare(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+						       uint16_t count, const enum MAPITAGS *tags, bool *cacheablep)
+{
+	struct emsmdbp_propset	*propset;
+	uint16_t		property_id, property_type;
+	uint16_t		i;
+
+	*cacheablep = true;
+
+	propset = talloc_zero(mem_ctx, struct emsmdbp_propset);
+	if (!propset) return NULL;
+
+	propset->count = count;
+	propset->tags = talloc_memdup(propset, tags, count * sizeof (enum MAPITAGS));
+	propset->properties.cValues = count;
+	propset->properties.aulPropTag = talloc_array(propset, enum MAPITAGS, count);
+	propset->untyped_status = talloc_zero_array(propset, bool, count);
+	if (count && (!propset->tags || !propset->properties.aulPropTag || !propset->untyped_status)) {
+		talloc_free(propset);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		propset->properties.aulPropTag[i] = tags[i];
+		if ((tags[i] & 0xffff) == 0) {
+			property_id = tags[i] >> 16;
+			if (property_id < 0x8000) {
+				property_type = get_property_type(property_id);
+			}
+			else {
+				property_type = 0;
+				mapistore_namedprops_get_nameid_type(emsmdbp_ctx->mstore_ctx->nprops_ctx, property_id, &property_type);
+				if (!property_type) {
+					*cacheablep = false;
+				}
+			}
+			if (property_type) {
+				propset->properties.aulPropTag[i] |= property_type;
+				propset->untyped_status[i] = true;
+			}
+			else {
+				propset->properties.aulPropTag[i] |= PT_ERROR; /* fail with a MAPI_E_NOT_FOUND */
+			}
+		}
+
+		switch (propset->properties.aulPropTag[i] & 0xffff) {
+		case PT_STRING8:
+		case PT_UNICODE:
+		case PT_BINARY:
+			propset->may_stream = true;
+			break;
+		}
+	}
+
+	return propset;
+}
+
+
+/**
+   \details Retrieve the prepared property set of a tag array, from
+   the session when it was prepared already
+
+   The set is owned by the session when it could be kept there and by
+   mem_ctx otherwise: callers must not free it. As backends may adjust
+   the tags they are given, callers should work on a copy of
+   propset->properties, see emsmdbp_propset_copy_tags.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param count the number of tags
+   \param tags the tags as sent by the client
+
+   \return the prepared property set on success, otherwise NULL
+ */
+_PUBLIC_ struct emsmdbp_propset *emsmdbp_propset_get(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+						     uint16_t count, const enum MAPITAGS *tags)
+{
+	struct emsmdbp_propset	*propset;
+	struct emsmdbp_propset	*last;
+	uint32_t		hash;
+	uint32_t		cached = 0;
+	bool			cacheable;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || (count && !tags)) return NULL;
+
+	hash = emsmdbp_propset_hash(count, tags);
+	for (propset = emsmdbp_ctx->propsets; propset; propset = propset->next) {
+		if (propset->hash == hash && propset->count == count
+		    && !memcmp(propset->tags, tags, count * sizeof (enum MAPITAGS))) {
+			/* most recently used first */
+			if (propset != emsmdbp_ctx->propsets) {
+				DLIST_REMOVE(emsmdbp_ctx->propsets, propset);
+				DLIST_ADD(emsmdbp_ctx->propsets, propset);
+			}
+			return propset;
+		}
+		cached++;
+	}
+
+	/* Allocated on the session right away, so that a kept set does not
+	   pin the memory of the call it was prepared in */
+	propset = emsmdbp_propset_prepare(emsmdbp_ctx, emsmdbp_ctx, count, tags, &cacheable);
+	if (!propset) return NULL;
+	if (!cacheable) {
+		return talloc_steal(mem_ctx, propset);
+	}
+
+	if (cached >= EMSMDBP_PROPSET_CACHE_SIZE) {
+		last = DLIST_TAIL(emsmdbp_ctx->propsets);
+		DLIST_REMOVE(emsmdbp_ctx->propsets, last);
+		talloc_free(last);
+	}
+	propset->hash = hash;
+	DLIST_ADD(emsmdbp_ctx->propsets, propset);
+
+	return propset;
+}
+
+
+/**
+   \details Return a copy of the resolved tags of a prepared property
+   set, which may be handed to the backends
+
+   \param mem_ctx pointer to the memory context
+   \param propset pointer to the prepared property set
+
+   \return the copy on success, otherwise NULL
+ */
+_PUBLIC_ struct SPropTagArray *emsmdbp_propset_copy_tags(TALLOC_CTX *mem_ctx, const struct emsmdbp_propset *propset)
+{
+	struct SPropTagArray	*properties;
+
+	if (!propset) return NULL;
+
+	properties = talloc_zero(mem_ctx, struct SPropTagArray);
+	if (!properties) return NULL;
+
+	properties->cValues = propset->count;
+	properties->aulPropTag = talloc_memdup(properties, propset->properties.aulPropTag,
+					       propset->count * sizeof (enum MAPITAGS));
+	if (propset->count && !properties->aulPropTag) {
+		talloc_free(properties);
+		return NULL;
+	}
+
+	return properties;
+}
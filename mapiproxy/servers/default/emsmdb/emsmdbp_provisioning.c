@@ -37,6 +37,39 @@
 
 #define MAILBOX_ROOT_NAME "OpenChange: %s"
 
+/* Bump when the folders provisioning creates or their properties
+   change, so that every mailbox is verified again */
+#define	EMSMDBP_PROVISIONING_VERSION		1
+/* Mailbox property recording the provisioning the mailbox is current
+   with, see provisioning_stamp */
+#define	EMSMDBP_PROVISIONING_STAMP_PROPTAG	0x67f1001f
+
+/* Folder names and special folders of a locale, built on the first
+   provisioning in that locale and kept for the life of the process */
+struct emsmdbp_provisioning_template {
+	struct emsmdbp_provisioning_template	*prev;
+	struct emsmdbp_provisioning_template	*next;
+	uint32_t				lcid;
+	const char				**folder_names;
+	struct emsmdbp_special_folder		*special_folders;
+};
+
+static struct emsmdbp_provisioning_template	*provisioning_templates = NULL;
+
+static const char *container_classes[MAPISTORE_MAX_ROLES] = {
+	[MAPISTORE_MAIL_ROLE] = "IPF.Note",
+	[MAPISTORE_DRAFTS_ROLE] = "IPF.Note",
+	[MAPISTORE_SENTITEMS_ROLE] = "IPF.Note",
+	[MAPISTORE_OUTBOX_ROLE] = "IPF.Note",
+	[MAPISTORE_DELETEDITEMS_ROLE] = "IPF.Note",
+	[MAPISTORE_CALENDAR_ROLE] = "IPF.Appointment",
+	[MAPISTORE_CONTACTS_ROLE] = "IPF.Contact",
+	[MAPISTORE_TASKS_ROLE] = "IPF.Task",
+	[MAPISTORE_NOTES_ROLE] = "IPF.StickyNote",
+	[MAPISTORE_JOURNAL_ROLE] = "IPF.Journal",
+	[MAPISTORE_FALLBACK_ROLE] = "IPF.Note"
+};
+
 static struct emsmdbp_special_folder *get_special_folders(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx)
 {
 	static struct emsmdbp_special_folder default_values[PROVISIONING_SPECIAL_FOLDERS_SIZE] = {
@@ -65,6 +98,145 @@ static const char **get_folders_names(TALLOC_CTX *mem_ctx, struct emsmdbp_contex
 	return ret;
 }
 
+/**
+   \details Return the provisioning template of the user locale,
+   building it on the first provisioning in that locale. Names read
+   from openchangedb are not read again until the process exits.
+
+   \param emsmdbp_ctx pointer to the emsmdbp context
+
+   \return the template on success, otherwise NULL
+ */
+static const struct emsmdbp_provisioning_template *get_provisioning_template(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_provisioning_template	*template;
+
+	for (template = provisioning_templates; template; template = template->next) {
+		if (template->lcid == emsmdbp_ctx->userLanguage) {
+			return template;
+		}
+	}
+
+	template = talloc_zero(NULL, struct emsmdbp_provisioning_template);
+	if (!template) return NULL;
+
+	template->lcid = emsmdbp_ctx->userLanguage;
+	template->folder_names = get_folders_names(template, emsmdbp_ctx);
+	template->special_folders = get_special_folders(template, emsmdbp_ctx);
+	if (!template->folder_names || !template->special_folders) {
+		talloc_free(template);
+		return NULL;
+	}
+	DLIST_ADD(provisioning_templates, template);
+
+	return template;
+}
+
+/**
+   \details Return the provisioning stamp of a mailbox: the provisioning
+   version, the user locale and a digest of the folders the backends
+   offer. A mailbox whose stored stamp is the same was fully provisioned
+   with the same input and has nothing to update.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdbp context
+   \param contexts_list the folders offered by the backends
+
+   \return the stamp on success, otherwise NULL
+ */
+static char *provisioning_stamp(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+				struct mapistore_contexts_list *contexts_list)
+{
+	struct mapistore_contexts_list	*entry;
+	const char			*srvtype;
+	const uint8_t			*p;
+	uint64_t			hash = 14695981039346656037ULL;
+	size_t				i, len;
+
+	for (entry = contexts_list; entry; entry = entry->next) {
+		p = (const uint8_t *) entry->url;
+		len = strlen(entry->url) + 1;
+		for (i = 0; i < len; i++) {
+			hash = (hash ^ p[i]) * 0x100000001b3ULL;
+		}
+		p = (const uint8_t *) (entry->name ? entry->name : "");
+		len = strlen((const char *) p) + 1;
+		for (i = 0; i < len; i++) {
+			hash = (hash ^ p[i]) * 0x100000001b3ULL;
+		}
+		hash = (hash ^ (entry->role & 0xff)) * 0x100000001b3ULL;
+		hash = (hash ^ entry->main_folder) * 0x100000001b3ULL;
+	}
+
+	srvtype = lpcfg_parm_string(emsmdbp_ctx->lp_ctx, NULL, "openchange", "srvtype");
+	if (srvtype) {
+		p = (const uint8_t *) srvtype;
+		len = strlen(srvtype);
+		for (i = 0; i < len; i++) {
+			hash = (hash ^ p[i]) * 0x100000001b3ULL;
+		}
+	}
+
+	return talloc_asprintf(mem_ctx, "%d:%"PRIu32":%.16"PRIx64, EMSMDBP_PROVISIONING_VERSION,
+			       emsmdbp_ctx->userLanguage, hash);
+}
+
+/**
+   \details Check whether the stored stamp of a mailbox is the given one
+
+   \return true if the mailbox is provisioned and current, otherwise false
+ */
+static bool provisioning_is_current(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+				    const char *username, const char *stamp)
+{
+	enum MAPISTATUS		ret;
+	uint64_t		mailbox_fid;
+	char			*stored = NULL;
+
+	ret = openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_MAILBOX_ROOT, &mailbox_fid);
+	if (ret != MAPI_E_SUCCESS) return false;
+
+	ret = openchangedb_get_folder_property(mem_ctx, emsmdbp_ctx->oc_ctx, username,
+					       EMSMDBP_PROVISIONING_STAMP_PROPTAG, mailbox_fid,
+					       (void **) &stored);
+	if (ret != MAPI_E_SUCCESS || !stored) return false;
+
+	return (strcmp(stored, stamp) == 0);
+}
+
+static void provisioning_set_stamp(struct emsmdbp_context *emsmdbp_ctx, const char *username,
+				   uint64_t mailbox_fid, const char *stamp)
+{
+	struct SRow		row;
+	struct SPropValue	prop;
+
+	prop.ulPropTag = EMSMDBP_PROVISIONING_STAMP_PROPTAG;
+	prop.value.lpszW = stamp;
+	row.cValues = 1;
+	row.lpProps = &prop;
+	openchangedb_set_folder_properties(emsmdbp_ctx->oc_ctx, username, mailbox_fid, &row);
+}
+
+/**
+   \details Clear the provisioning stamp of a mailbox, so the next
+   logon verifies it entirely
+
+   \param emsmdbp_ctx pointer to the emsmdbp context
+   \param username the owner of the mailbox
+ */
+_PUBLIC_ void emsmdbp_mailbox_provision_invalidate(struct emsmdbp_context *emsmdbp_ctx, const char *username)
+{
+	uint64_t	mailbox_fid;
+
+	if (!emsmdbp_ctx || !username) return;
+
+	if (openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_MAILBOX_ROOT,
+					    &mailbox_fid) != MAPI_E_SUCCESS) {
+		return;
+	}
+	provisioning_set_stamp(emsmdbp_ctx, username, mailbox_fid, "");
+}
+
 static enum MAPISTATUS get_new_public_folder_id(struct emsmdbp_context *emsmdbp_ctx, uint64_t parent_fid, uint64_t *fid)
 {
 	enum MAPISTATUS		retval = MAPI_E_SUCCESS;
@@ -292,15 +464,15 @@ FolderId: 0x67ca828f02000001      Display Name: "                        ";  Con
 	struct mapistore_contexts_list		*contexts_list;
 	struct StringArrayW_r			*existing_uris;
 	struct mapistore_contexts_list		*main_entries[MAPISTORE_MAX_ROLES], *secondary_entries[MAPISTORE_MAX_ROLES], *next_entry, *current_entry;
+	const struct emsmdbp_provisioning_template	*template;
 	const char				**folder_names;
-	struct emsmdbp_special_folder		*special_folders;
-	const char				**container_classes;
+	const struct emsmdbp_special_folder	*special_folders;
 	const char				*search_container_classes[] = {"Outlook.Reminder", "IPF.Task", "IPF.Note"};
 	uint32_t				context_id, row_count;
 	uint64_t				mailbox_fid = 0, ipm_fid, inbox_fid = 0, current_fid, current_mid, found_fid, current_cn;
-	char					*fallback_url, *entryid_dump, *url;
+	char					*fallback_url, *entryid_dump, *url, *stamp;
 	const char				*mapistore_url, *current_name, *base_name;
-	struct emsmdbp_special_folder		*current_folder;
+	const struct emsmdbp_special_folder	*current_folder;
 	struct SRow				property_row;
 	int					i, j;
 	DATA_BLOB				entryid_data;
@@ -337,6 +509,24 @@ FolderId: 0x67ca828f02000001      Display Name: "                        ";  Con
 		current_entry = current_entry->next;
 	}
 
+	/* Skip the verification of a mailbox already provisioned with
+	   the same backend folders, locale and provisioning version */
+	stamp = provisioning_stamp(mem_ctx, emsmdbp_ctx, contexts_list);
+	if (stamp && lpcfg_parm_bool(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "provisioning_stamp", true) &&
+	    provisioning_is_current(mem_ctx, emsmdbp_ctx, username, stamp)) {
+		OC_DEBUG(5, "mailbox of %s is provisioned and current (%s)", username, stamp);
+		talloc_free(mem_ctx);
+		return MAPI_E_SUCCESS;
+	}
+
+	template = get_provisioning_template(emsmdbp_ctx);
+	if (!template) {
+		talloc_free(mem_ctx);
+		return MAPI_E_NOT_ENOUGH_MEMORY;
+	}
+	folder_names = template->folder_names;
+	special_folders = template->special_folders;
+
 	openchangedb_transaction_start(emsmdbp_ctx->oc_ctx);
 
 	/* Retrieve list of existing entries */
@@ -369,16 +559,6 @@ FolderId: 0x67ca828f02000001      Display Name: "                        ";  Con
 		}
 	}
 
-	container_classes = talloc_array(mem_ctx, const char *, MAPISTORE_MAX_ROLES);
-	for (i = MAPISTORE_MAIL_ROLE; i < MAPISTORE_MAX_ROLES; i++) {
-		container_classes[i] = "IPF.Note";
-	}
-	container_classes[MAPISTORE_CALENDAR_ROLE] = "IPF.Appointment";
-	container_classes[MAPISTORE_CONTACTS_ROLE] = "IPF.Contact";
-	container_classes[MAPISTORE_TASKS_ROLE] = "IPF.Task";
-	container_classes[MAPISTORE_NOTES_ROLE] = "IPF.StickyNote";
-	container_classes[MAPISTORE_JOURNAL_ROLE] = "IPF.Journal";
-
 	memset(&property_row, 0, sizeof(struct SRow));
 	memset(main_entries, 0, sizeof(struct mapistore_contexts_list *) * MAPISTORE_MAX_ROLES);
 	memset(secondary_entries, 0, sizeof(struct mapistore_contexts_list *) * MAPISTORE_MAX_ROLES);
@@ -418,7 +598,6 @@ FolderId: 0x67ca828f02000001      Display Name: "                        ";  Con
 	}
 
 	/* Mailbox and subfolders */
-	folder_names = get_folders_names(mem_ctx, emsmdbp_ctx);
 	ret = openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_MAILBOX_ROOT, &mailbox_fid);
 	if (ret != MAPI_E_SUCCESS) {
 		mapistore_indexing_get_new_folderID_as_user(emsmdbp_ctx->mstore_ctx, username, &mailbox_fid);
@@ -624,7 +803,6 @@ FolderId: 0x67ca828f02000001      Display Name: "                        ";  Con
 	folder_entryid.FolderType = eitLTPrivateFolder;
 	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username, NULL, &folder_entryid.FolderDatabaseGuid);
 
-	special_folders = get_special_folders(mem_ctx, emsmdbp_ctx);
 	for (i = 0; i < PROVISIONING_SPECIAL_FOLDERS_SIZE; i++) {
 		current_folder = special_folders + i;
 		ret = openchangedb_get_folder_property(mem_ctx, emsmdbp_ctx->oc_ctx, username, current_folder->entryid_property, mailbox_fid, (void **) &entryId);
@@ -879,6 +1057,12 @@ FolderId: 0x67ca828f02000001      Display Name: "                        ";  Con
 		}
 	}
 
+	/* Only the owner provisions the Freebusy Data folder, so only the
+	   verification it runs makes the mailbox current */
+	if (stamp && strcmp(emsmdbp_ctx->username, username) == 0) {
+		provisioning_set_stamp(emsmdbp_ctx, username, mailbox_fid, stamp);
+	}
+
 	openchangedb_transaction_commit(emsmdbp_ctx->oc_ctx);
 
 
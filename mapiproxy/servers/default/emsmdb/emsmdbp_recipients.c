@@ -0,0 +1,286 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_recipients.c
+
+   \brief Cached recipient resolution
+
+   ModifyRecipients resolves the X500 address of every address book
+   recipient to its account, and recipient rows are built from the
+   account record, one SAMDB search per recipient each time. Drafts
+   saved again and large distribution lists repeat the same searches.
+
+   Recipients are resolved here with the four attributes recipient rows
+   need. When emsmdb:recipient_cache_ttl is set, the worker process
+   keeps the records found for that many seconds, and the addresses
+   which resolve to no account for
+   emsmdb:recipient_cache_negative_ttl seconds.
+ */
+
+#include <ctype.h>
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "mapiproxy/util/ccan/htable/htable.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+#define	EMSMDBP_RECIPIENT_CACHE_MAX		4096
+#define	EMSMDBP_RECIPIENT_NEGATIVE_TTL		60
+
+struct emsmdbp_recipient_cache_entry {
+	struct emsmdbp_recipient_cache_entry	*prev;
+	struct emsmdbp_recipient_cache_entry	*next;
+	enum emsmdbp_recipient_key		key;
+	char					*value;
+	size_t					hash;
+	struct emsmdbp_recipient		*recipient;	/* NULL when not found */
+	time_t					fetched;
+};
+
+static size_t emsmdbp_recipient_cache_rehash(const void *e, void *unused)
+{
+	return ((const struct emsmdbp_recipient_cache_entry *)e)->hash;
+}
+
+/* Most recently used first */
+static struct emsmdbp_recipient_cache_entry	*recipient_cache = NULL;
+static uint32_t					recipient_cache_count = 0;
+static struct htable				recipient_cache_ht = HTABLE_INITIALIZER(recipient_cache_ht, emsmdbp_recipient_cache_rehash, NULL);
+
+
+/**
+   \details Hash a recipient address, regardless of its case as SAMDB
+   matches it
+ */
+static size_t emsmdbp_recipient_hash(enum emsmdbp_recipient_key key, const char *value)
+{
+	char	*lowered;
+	size_t	h = key;
+	size_t	i;
+
+	lowered = talloc_strdup(NULL, value);
+	if (lowered) {
+		for (i = 0; lowered[i]; i++) {
+			lowered[i] = tolower((unsigned char) lowered[i]);
+		}
+		h ^= hash_string(lowered);
+		talloc_free(lowered);
+	}
+
+	return h;
+}
+
+
+static struct emsmdbp_recipient *emsmdbp_recipient_copy(TALLOC_CTX *mem_ctx, const struct emsmdbp_recipient *src)
+{
+	struct emsmdbp_recipient	*recipient;
+
+	recipient = talloc_zero(mem_ctx, struct emsmdbp_recipient);
+	if (!recipient) return NULL;
+
+	recipient->account = talloc_strdup(recipient, src->account);
+	recipient->display_name = talloc_strdup(recipient, src->display_name);
+	recipient->nickname = talloc_strdup(recipient, src->nickname);
+	recipient->legacyExchangeDN = talloc_strdup(recipient, src->legacyExchangeDN);
+
+	return recipient;
+}
+
+
+static struct emsmdbp_recipient_cache_entry *emsmdbp_recipient_cache_find(enum emsmdbp_recipient_key key,
+									  const char *value, size_t h)
+{
+	struct emsmdbp_recipient_cache_entry	*entry;
+	struct htable_iter			iter;
+
+	for (entry = htable_firstval(&recipient_cache_ht, &iter, h); entry;
+	     entry = htable_nextval(&recipient_cache_ht, &iter, h)) {
+		if (entry->key == key && !strcasecmp(entry->value, value)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+static void emsmdbp_recipient_cache_remove(struct emsmdbp_recipient_cache_entry *entry)
+{
+	htable_del(&recipient_cache_ht, entry->hash, entry);
+	DLIST_REMOVE(recipient_cache, entry);
+	talloc_free(entry);
+	recipient_cache_count--;
+}
+
+
+static void emsmdbp_recipient_cache_store(enum emsmdbp_recipient_key key, const char *value, size_t h,
+					  const struct emsmdbp_recipient *recipient)
+{
+	struct emsmdbp_recipient_cache_entry	*entry;
+
+	entry = emsmdbp_recipient_cache_find(key, value, h);
+	if (entry) {
+		emsmdbp_recipient_cache_remove(entry);
+	} else if (recipient_cache_count >= EMSMDBP_RECIPIENT_CACHE_MAX) {
+		emsmdbp_recipient_cache_remove(DLIST_TAIL(recipient_cache));
+	}
+
+	entry = talloc_zero(NULL, struct emsmdbp_recipient_cache_entry);
+	if (!entry) return;
+	entry->key = key;
+	entry->hash = h;
+	entry->fetched = time(NULL);
+	entry->value = talloc_strdup(entry, value);
+	if (!entry->value) {
+		talloc_free(entry);
+		return;
+	}
+	if (recipient) {
+		entry->recipient = emsmdbp_recipient_copy(entry, recipient);
+		if (!entry->recipient) {
+			talloc_free(entry);
+			return;
+		}
+	}
+	if (!htable_add(&recipient_cache_ht, h, entry)) {
+		talloc_free(entry);
+		return;
+	}
+
+	DLIST_ADD(recipient_cache, entry);
+	recipient_cache_count++;
+}
+
+
+/**
+   \details Search SAMDB for a recipient
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND when no account
+   matches, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_recipient_search(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+						enum emsmdbp_recipient_key key, const char *value,
+						struct emsmdbp_recipient **recipientp)
+{
+	TALLOC_CTX			*local_mem_ctx;
+	struct emsmdbp_recipient	*recipient;
+	struct ldb_result		*res = NULL;
+	const char * const		attrs[] = { "sAMAccountName", "displayName", "mailNickname", "legacyExchangeDN", NULL };
+	int				ret;
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	switch (key) {
+	case EMSMDBP_RECIPIENT_BY_NAME:
+		ret = ldb_search(emsmdbp_ctx->samdb_ctx, local_mem_ctx, &res,
+				 ldb_get_default_basedn(emsmdbp_ctx->samdb_ctx),
+				 LDB_SCOPE_SUBTREE, attrs,
+				 "(&(objectClass=user)(sAMAccountName=*%s*)(!(objectClass=computer)))",
+				 ldb_binary_encode_string(local_mem_ctx, value));
+		OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS || !res->count, MAPI_E_NOT_FOUND, local_mem_ctx);
+		break;
+	case EMSMDBP_RECIPIENT_BY_X500:
+		ret = ldb_search(emsmdbp_ctx->samdb_ctx, local_mem_ctx, &res,
+				 ldb_get_default_basedn(emsmdbp_ctx->samdb_ctx),
+				 LDB_SCOPE_SUBTREE, attrs, "legacyExchangeDN=%s",
+				 ldb_binary_encode_string(local_mem_ctx, value));
+		OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS || res->count != 1, MAPI_E_NOT_FOUND, local_mem_ctx);
+		break;
+	default:
+		OPENCHANGE_RETVAL_ERR(MAPI_E_INVALID_PARAMETER, local_mem_ctx);
+	}
+
+	recipient = talloc_zero(mem_ctx, struct emsmdbp_recipient);
+	OPENCHANGE_RETVAL_IF(!recipient, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	recipient->account = talloc_strdup(recipient, ldb_msg_find_attr_as_string(res->msgs[0], "sAMAccountName", NULL));
+	recipient->display_name = talloc_strdup(recipient, ldb_msg_find_attr_as_string(res->msgs[0], "displayName", NULL));
+	recipient->nickname = talloc_strdup(recipient, ldb_msg_find_attr_as_string(res->msgs[0], "mailNickname", NULL));
+	recipient->legacyExchangeDN = talloc_strdup(recipient, ldb_msg_find_attr_as_string(res->msgs[0], "legacyExchangeDN", NULL));
+
+	talloc_free(local_mem_ctx);
+	*recipientp = recipient;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Resolve a recipient to its account record
+
+   \param mem_ctx pointer to the memory context the record is
+   allocated with
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param key the kind of address to resolve
+   \param value the address: part of the account name or the X500
+   address
+   \param recipientp pointer on pointer to the returned record. Its
+   attributes missing in SAMDB are NULL
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND when no account
+   matches, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_recipient_resolve(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+						   enum emsmdbp_recipient_key key, const char *value,
+						   struct emsmdbp_recipient **recipientp)
+{
+	struct emsmdbp_recipient_cache_entry	*entry;
+	struct emsmdbp_recipient		*recipient = NULL;
+	enum MAPISTATUS				retval;
+	size_t					h;
+	int					ttl, negative_ttl;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx->samdb_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!value || !recipientp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	ttl = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "recipient_cache_ttl", 0);
+	if (ttl <= 0) {
+		return emsmdbp_recipient_search(mem_ctx, emsmdbp_ctx, key, value, recipientp);
+	}
+	negative_ttl = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "recipient_cache_negative_ttl",
+				      MIN(ttl, EMSMDBP_RECIPIENT_NEGATIVE_TTL));
+
+	h = emsmdbp_recipient_hash(key, value);
+	entry = emsmdbp_recipient_cache_find(key, value, h);
+	if (entry && time(NULL) - entry->fetched < (entry->recipient ? ttl : negative_ttl)) {
+		DLIST_PROMOTE(recipient_cache, entry);
+		OPENCHANGE_RETVAL_IF(!entry->recipient, MAPI_E_NOT_FOUND, NULL);
+
+		recipient = emsmdbp_recipient_copy(mem_ctx, entry->recipient);
+		OPENCHANGE_RETVAL_IF(!recipient, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		*recipientp = recipient;
+		return MAPI_E_SUCCESS;
+	}
+
+	retval = emsmdbp_recipient_search(mem_ctx, emsmdbp_ctx, key, value, &recipient);
+	if (retval == MAPI_E_SUCCESS) {
+		emsmdbp_recipient_cache_store(key, value, h, recipient);
+		*recipientp = recipient;
+	} else if (retval == MAPI_E_NOT_FOUND && negative_ttl > 0) {
+		emsmdbp_recipient_cache_store(key, value, h, NULL);
+	}
+
+	return retval;
+}
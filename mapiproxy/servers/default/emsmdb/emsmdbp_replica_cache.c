@@ -0,0 +1,157 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_replica_cache.c
+
+   \brief Replica identifiers resolved in a session
+
+   Converting between short-term and long-term identifiers maps the
+   replica identifier to the replica GUID and back, which reads the
+   mailbox replica from openchangedb and the replica mapping of
+   mapistore. Clients convert identifiers in bulk (favorites,
+   reminders, search folders), always for the same few replicas.
+
+   A replica identifier is never mapped to another GUID once
+   assigned, so the session keeps the pairs it resolved without
+   expiring them. Failed lookups are not kept: the mapping may be
+   created later.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Number of replicas kept on a session */
+#define	EMSMDBP_REPLICA_CACHE_SIZE	64
+
+
+static void emsmdbp_replica_cache_promote(struct emsmdbp_context *emsmdbp_ctx,
+					  struct emsmdbp_replica_cache *entry)
+{
+	/* most recently used first */
+	if (entry != emsmdbp_ctx->replica_cache) {
+		DLIST_REMOVE(emsmdbp_ctx->replica_cache, entry);
+		DLIST_ADD(emsmdbp_ctx->replica_cache, entry);
+	}
+}
+
+
+/**
+   \details Retrieve the GUID of a replica resolved earlier in this
+   session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox
+   \param replid the replica identifier
+   \param guidp pointer to the replica GUID to return
+
+   \return true if the replica is known, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_replica_cache_get_guid(struct emsmdbp_context *emsmdbp_ctx, const char *owner,
+					     uint16_t replid, struct GUID *guidp)
+{
+	struct emsmdbp_replica_cache	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner || !guidp) return false;
+
+	for (entry = emsmdbp_ctx->replica_cache; entry; entry = entry->next) {
+		if (entry->replid == replid && !strcmp(entry->owner, owner)) {
+			emsmdbp_replica_cache_promote(emsmdbp_ctx, entry);
+			*guidp = entry->guid;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+   \details Retrieve the identifier of a replica resolved earlier in
+   this session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox
+   \param guid pointer to the replica GUID
+   \param replidp pointer to the replica identifier to return
+
+   \return true if the replica is known, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_replica_cache_get_replid(struct emsmdbp_context *emsmdbp_ctx, const char *owner,
+					       const struct GUID *guid, uint16_t *replidp)
+{
+	struct emsmdbp_replica_cache	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner || !guid || !replidp) return false;
+
+	for (entry = emsmdbp_ctx->replica_cache; entry; entry = entry->next) {
+		if (GUID_equal(&entry->guid, guid) && !strcmp(entry->owner, owner)) {
+			emsmdbp_replica_cache_promote(emsmdbp_ctx, entry);
+			*replidp = entry->replid;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+   \details Remember a replica identifier and its GUID
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox
+   \param replid the replica identifier
+   \param guid pointer to the replica GUID
+ */
+_PUBLIC_ void emsmdbp_replica_cache_set(struct emsmdbp_context *emsmdbp_ctx, const char *owner,
+					uint16_t replid, const struct GUID *guid)
+{
+	struct emsmdbp_replica_cache	*entry;
+	struct GUID			known;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !owner || !guid) return;
+	if (emsmdbp_replica_cache_get_guid(emsmdbp_ctx, owner, replid, &known)) return;
+
+	entry = talloc_zero(emsmdbp_ctx, struct emsmdbp_replica_cache);
+	if (!entry) return;
+	entry->owner = talloc_strdup(entry, owner);
+	if (!entry->owner) {
+		talloc_free(entry);
+		return;
+	}
+	entry->replid = replid;
+	entry->guid = *guid;
+
+	if (emsmdbp_ctx->replica_cache_count >= EMSMDBP_REPLICA_CACHE_SIZE) {
+		struct emsmdbp_replica_cache	*last;
+
+		last = DLIST_TAIL(emsmdbp_ctx->replica_cache);
+		DLIST_REMOVE(emsmdbp_ctx->replica_cache, last);
+		talloc_free(last);
+		emsmdbp_ctx->replica_cache_count--;
+	}
+	DLIST_ADD(emsmdbp_ctx->replica_cache, entry);
+	emsmdbp_ctx->replica_cache_count++;
+}
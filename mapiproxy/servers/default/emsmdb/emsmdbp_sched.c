@@ -0,0 +1,150 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_sched.c
+
+   \brief Interactive and bulk ROPs
+
+   ROPs are either interactive, such as QueryRows or GetProps, or bulk:
+   the ones starting or feeding a fast transfer or a synchronization,
+   and ReadStream asking for at least emsmdb:bulk_read_stream_size
+   bytes. Bulk work is the first one delayed under load (see
+   emsmdbp_load.c) and the last one picked by the worker threads (see
+   emsmdbp_threads.c).
+
+   When emsmdb:bulk_time_slice is set, a call only spends that many
+   milliseconds producing synchronization streams: the producers stop
+   at the next message or folder boundary and return a shorter buffer,
+   and EcDoRpcExt2 stops chaining extended buffers. The client asks
+   for the rest with its next call, which is queued behind the
+   interactive calls of the other sessions.
+ */
+
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+static bool	emsmdbp_sched_initialized = false;
+static uint32_t	emsmdbp_sched_read_stream_size = 0x4000;
+static uint32_t	emsmdbp_sched_time_slice = 0;
+
+static void emsmdbp_sched_init(struct loadparm_context *lp_ctx)
+{
+	int	value;
+
+	if (emsmdbp_sched_initialized) return;
+	emsmdbp_sched_initialized = true;
+
+	value = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "bulk_read_stream_size", 0x4000);
+	emsmdbp_sched_read_stream_size = (value > 0) ? value : 0;
+
+	value = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "bulk_time_slice", 0);
+	emsmdbp_sched_time_slice = (value > 0) ? value : 0;
+}
+
+
+/**
+   \details Start the time slice of a call
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_sched_begin(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct timespec	*deadline;
+
+	if (!emsmdbp_ctx) return;
+
+	emsmdbp_sched_init(emsmdbp_ctx->lp_ctx);
+
+	deadline = &emsmdbp_ctx->slice_deadline;
+	if (!emsmdbp_sched_time_slice) {
+		deadline->tv_sec = 0;
+		deadline->tv_nsec = 0;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	deadline->tv_sec += emsmdbp_sched_time_slice / 1000;
+	deadline->tv_nsec += (emsmdbp_sched_time_slice % 1000) * 1000000;
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+}
+
+
+/**
+   \details Return whether the current call spent its time slice and
+   bulk producers should stop at the next boundary
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+
+   \return true if the producer should yield, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_sched_yield(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct timespec	now;
+
+	if (!emsmdbp_ctx || !emsmdbp_ctx->slice_deadline.tv_sec) return false;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec != emsmdbp_ctx->slice_deadline.tv_sec) {
+		return (now.tv_sec > emsmdbp_ctx->slice_deadline.tv_sec);
+	}
+	return (now.tv_nsec >= emsmdbp_ctx->slice_deadline.tv_nsec);
+}
+
+
+/**
+   \details Return whether a ROP is bulk work
+
+   \param mapi_req pointer to the ROP request
+
+   \return true for bulk ROPs, false for interactive ones
+ */
+_PUBLIC_ bool emsmdbp_sched_bulk_rop(const struct EcDoRpc_MAPI_REQ *mapi_req)
+{
+	const struct ReadStream_req	*request;
+	uint32_t			size;
+
+	if (!mapi_req) return false;
+
+	switch (mapi_req->opnum) {
+	case op_MAPI_FastTransferSourceCopyMessages:
+	case op_MAPI_FastTransferSourceCopyFolder:
+	case op_MAPI_FastTransferSourceCopyTo:
+	case op_MAPI_FastTransferSourceCopyProps:
+	case op_MAPI_FastTransferSourceGetBuffer:
+	case op_MAPI_SyncConfigure:
+		return true;
+	case op_MAPI_ReadStream:
+		request = &mapi_req->u.mapi_ReadStream;
+		size = request->ByteCount;
+		if (size == 0xBABE) {
+			size = request->MaximumByteCount.value;
+		}
+		return (emsmdbp_sched_read_stream_size && size >= emsmdbp_sched_read_stream_size);
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,987 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_search.c
+
+   \brief Search folders
+
+   The criteria of a search folder (restriction, folders searched and
+   search flags) are kept in openchangedb with the folder. The messages
+   matching them are materialized in the session the first time the
+   search folder is used: the folders searched are walked once and
+   their rows evaluated with the restriction compiler.
+
+   The membership is then maintained incrementally. Messages created,
+   modified or moved by the session and the object notifications it
+   receives queue the message for a new evaluation, applied the next
+   time the search folder is read. Deleted messages leave the search
+   folder right away. Past EMSMDBP_SEARCH_CHANGES_MAX queued changes,
+   the folders are searched again instead.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+#define	EMSMDBP_SEARCH_CRITERIA_VERSION	1
+#define	EMSMDBP_SEARCH_CHANGES_MAX	256
+#define	EMSMDBP_SEARCH_DEPTH_MAX	32
+
+
+static struct emsmdbp_search_folder *emsmdbp_search_find(struct emsmdbp_context *emsmdbp_ctx, const char *owner, uint64_t fid)
+{
+	struct emsmdbp_search_folder	*search;
+
+	for (search = emsmdbp_ctx->search_folders; search; search = search->next) {
+		if (search->fid == fid && !strcmp(search->owner, owner)) {
+			return search;
+		}
+	}
+
+	return NULL;
+}
+
+
+static bool emsmdbp_search_in_scope(const struct emsmdbp_search_folder *search, uint64_t fid)
+{
+	uint32_t	i;
+
+	for (i = 0; i < search->folder_count; i++) {
+		if (search->folders[i] == fid) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static bool emsmdbp_search_member_find(const struct emsmdbp_search_folder *search, uint64_t fid, uint64_t mid, uint32_t *indexp)
+{
+	uint32_t	i;
+
+	for (i = 0; i < search->count; i++) {
+		if (search->members[i].mid == mid && search->members[i].fid == fid) {
+			*indexp = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static bool emsmdbp_search_member_add(struct emsmdbp_search_folder *search, uint64_t fid, uint64_t mid)
+{
+	struct emsmdbp_search_member	*members;
+	uint32_t			i;
+
+	if (emsmdbp_search_member_find(search, fid, mid, &i)) {
+		return false;
+	}
+
+	members = talloc_realloc(search, search->members, struct emsmdbp_search_member, search->count + 1);
+	if (!members) {
+		OC_DEBUG(0, "No more memory");
+		return false;
+	}
+	members[search->count].fid = fid;
+	members[search->count].mid = mid;
+	search->members = members;
+	search->count++;
+
+	return true;
+}
+
+
+static bool emsmdbp_search_member_remove(struct emsmdbp_search_folder *search, uint64_t fid, uint64_t mid)
+{
+	uint32_t	i;
+
+	if (!emsmdbp_search_member_find(search, fid, mid, &i)) {
+		return false;
+	}
+
+	memmove(search->members + i, search->members + i + 1, (search->count - i - 1) * sizeof (struct emsmdbp_search_member));
+	search->count--;
+
+	return true;
+}
+
+
+static void emsmdbp_search_folder_members_remove(struct emsmdbp_search_folder *search, uint64_t fid)
+{
+	uint32_t	i, count = 0;
+
+	for (i = 0; i < search->count; i++) {
+		if (search->members[i].fid != fid) {
+			search->members[count++] = search->members[i];
+		}
+	}
+	search->count = count;
+}
+
+
+static void emsmdbp_search_reset(struct emsmdbp_search_folder *search)
+{
+	talloc_free(search->members);
+	search->members = NULL;
+	search->count = 0;
+	talloc_free(search->changes);
+	search->changes = NULL;
+	search->change_count = 0;
+	talloc_free(search->folders);
+	search->folders = NULL;
+	search->folder_count = 0;
+	search->complete = false;
+}
+
+
+/**
+   \details Queue a message, or a whole folder when mid is 0, for a new
+   evaluation
+ */
+static void emsmdbp_search_queue(struct emsmdbp_search_folder *search, uint64_t fid, uint64_t mid)
+{
+	struct emsmdbp_search_change	*changes;
+	uint32_t			i;
+
+	for (i = 0; i < search->change_count; i++) {
+		if (search->changes[i].fid == fid && (search->changes[i].mid == mid || !search->changes[i].mid)) {
+			return;
+		}
+	}
+
+	if (search->change_count >= EMSMDBP_SEARCH_CHANGES_MAX) {
+		OC_DEBUG(5, "too many changes queued on search folder 0x%"PRIx64", searching again", search->fid);
+		talloc_free(search->changes);
+		search->changes = NULL;
+		search->change_count = 0;
+		search->complete = false;
+		return;
+	}
+
+	changes = talloc_realloc(search, search->changes, struct emsmdbp_search_change, search->change_count + 1);
+	if (!changes) {
+		search->complete = false;
+		return;
+	}
+	changes[search->change_count].fid = fid;
+	changes[search->change_count].mid = mid;
+	search->changes = changes;
+	search->change_count++;
+}
+
+
+/**
+   \details Pack the criteria of a search folder into a blob
+ */
+static enum MAPISTATUS emsmdbp_search_criteria_pack(TALLOC_CTX *mem_ctx, uint32_t flags, const struct mapi_SRestriction *res,
+						    uint16_t scope_count, const uint64_t *scope, DATA_BLOB *blob)
+{
+	struct ndr_push		*ndr;
+	DATA_BLOB		res_blob;
+	enum ndr_err_code	ndr_err_code;
+	uint32_t		i;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	OPENCHANGE_RETVAL_IF(!ndr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+
+	ndr_push_uint32(ndr, NDR_SCALARS, EMSMDBP_SEARCH_CRITERIA_VERSION);
+	ndr_push_uint32(ndr, NDR_SCALARS, flags);
+	ndr_push_uint16(ndr, NDR_SCALARS, scope_count);
+	for (i = 0; i < scope_count; i++) {
+		ndr_push_hyper(ndr, NDR_SCALARS, scope[i]);
+	}
+	ndr_err_code = ndr_push_struct_blob(&res_blob, ndr, res, (ndr_push_flags_fn_t)ndr_push_mapi_SRestriction);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_INVALID_PARAMETER, ndr);
+	ndr_push_DATA_BLOB(ndr, NDR_SCALARS, res_blob);
+
+	blob->data = talloc_steal(mem_ctx, ndr->data);
+	blob->length = ndr->offset;
+	talloc_free(ndr);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Unpack the criteria of a search folder and compile its
+   restriction
+ */
+static enum MAPISTATUS emsmdbp_search_criteria_unpack(struct emsmdbp_search_folder *search, const DATA_BLOB *blob)
+{
+	enum MAPISTATUS		retval;
+	struct ndr_pull		*ndr;
+	DATA_BLOB		res_blob;
+	enum ndr_err_code	ndr_err_code;
+	uint32_t		version;
+	uint32_t		i;
+
+	talloc_free(search->scope);
+	talloc_free(search->res);
+	talloc_free(search->program);
+	talloc_free(search->proptags);
+	search->scope = NULL;
+	search->scope_count = 0;
+	search->res = NULL;
+	search->program = NULL;
+	search->proptags = NULL;
+
+	ndr = ndr_pull_init_blob(blob, search);
+	OPENCHANGE_RETVAL_IF(!ndr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+
+	ndr_err_code = ndr_pull_uint32(ndr, NDR_SCALARS, &version);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, ndr);
+	OPENCHANGE_RETVAL_IF(version != EMSMDBP_SEARCH_CRITERIA_VERSION, MAPI_E_VERSION, ndr);
+	ndr_err_code = ndr_pull_uint32(ndr, NDR_SCALARS, &search->flags);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, ndr);
+	ndr_err_code = ndr_pull_uint16(ndr, NDR_SCALARS, &search->scope_count);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, ndr);
+
+	search->scope = talloc_array(search, uint64_t, search->scope_count);
+	OPENCHANGE_RETVAL_IF(search->scope_count && !search->scope, MAPI_E_NOT_ENOUGH_MEMORY, ndr);
+	for (i = 0; i < search->scope_count; i++) {
+		ndr_err_code = ndr_pull_hyper(ndr, NDR_SCALARS, &search->scope[i]);
+		OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, ndr);
+	}
+
+	ndr_err_code = ndr_pull_DATA_BLOB(ndr, NDR_SCALARS, &res_blob);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, ndr);
+	search->res = talloc_zero(search, struct mapi_SRestriction);
+	OPENCHANGE_RETVAL_IF(!search->res, MAPI_E_NOT_ENOUGH_MEMORY, ndr);
+	ndr_err_code = ndr_pull_struct_blob_all(&res_blob, search->res, search->res,
+						(ndr_pull_flags_fn_t)ndr_pull_mapi_SRestriction);
+	OPENCHANGE_RETVAL_IF(!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code), MAPI_E_CORRUPT_DATA, ndr);
+	talloc_free(ndr);
+
+	retval = mapiproxy_restriction_compile(search, search->res, &search->program);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	/* Rows are read with their identifier and what the restriction needs */
+	search->proptags = set_SPropTagArray(search, 1, PidTagMid);
+	OPENCHANGE_RETVAL_IF(!search->proptags, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	return mapiproxy_restriction_add_proptags(search->proptags, search->program, search->proptags);
+}
+
+
+/**
+   \details Load the criteria of a search folder from openchangedb
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT if the folder is
+   not a search folder, MAPI_E_NOT_INITIALIZED if no criteria were set
+   on it yet, otherwise MAPI error
+ */
+static enum MAPISTATUS emsmdbp_search_load(struct emsmdbp_context *emsmdbp_ctx, const char *owner, uint64_t fid,
+					   struct emsmdbp_search_folder **searchp)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct emsmdbp_search_folder	*search;
+	struct Binary_r			*bin = NULL;
+	uint32_t			*folder_type = NULL;
+	DATA_BLOB			blob;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = openchangedb_get_folder_property(mem_ctx, emsmdbp_ctx->oc_ctx, owner, PidTagFolderType, fid, (void **)&folder_type);
+	OPENCHANGE_RETVAL_IF(retval || !folder_type || *folder_type != FOLDER_SEARCH, MAPI_E_NO_SUPPORT, mem_ctx);
+
+	search = talloc_zero(emsmdbp_ctx, struct emsmdbp_search_folder);
+	OPENCHANGE_RETVAL_IF(!search, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	search->owner = talloc_strdup(search, owner);
+	OPENCHANGE_RETVAL_IF(!search->owner, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	search->fid = fid;
+
+	retval = openchangedb_get_folder_property(mem_ctx, emsmdbp_ctx->oc_ctx, owner, EMSMDBP_SEARCH_CRITERIA_PROPTAG, fid, (void **)&bin);
+	if (retval == MAPI_E_SUCCESS && bin && bin->cb) {
+		blob.data = bin->lpb;
+		blob.length = bin->cb;
+		retval = emsmdbp_search_criteria_unpack(search, &blob);
+		if (retval) {
+			OC_DEBUG(3, "unable to read the criteria of search folder 0x%"PRIx64": %s", fid, mapi_get_errstr(retval));
+			talloc_free(search);
+			talloc_free(mem_ctx);
+			return retval;
+		}
+	}
+	talloc_free(mem_ctx);
+
+	DLIST_ADD(emsmdbp_ctx->search_folders, search);
+	*searchp = search;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Add a folder and, for recursive searches, its subfolders to
+   the folders searched
+ */
+static void emsmdbp_search_collect_folders(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *context_object,
+					   struct emsmdbp_search_folder *search, uint64_t fid, uint32_t depth)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct emsmdbp_object		*folder = NULL;
+	struct emsmdbp_object		*table_object;
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_table_row_props	*rows;
+	uint64_t			*folders;
+	enum MAPITAGS			proptag = PidTagFolderId;
+	uint32_t			i, start, count, fetched;
+
+	/* The search folder is never part of its own results */
+	if (fid == search->fid || emsmdbp_search_in_scope(search, fid)) return;
+
+	folders = talloc_realloc(search, search->folders, uint64_t, search->folder_count + 1);
+	if (!folders) return;
+	folders[search->folder_count++] = fid;
+	search->folders = folders;
+
+	if (!(search->flags & RECURSIVE_SEARCH) || depth >= EMSMDBP_SEARCH_DEPTH_MAX) return;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	retval = emsmdbp_object_open_folder_by_fid(mem_ctx, emsmdbp_ctx, context_object, fid, &folder);
+	if (retval) goto end;
+
+	table_object = emsmdbp_folder_open_table(mem_ctx, folder, MAPISTORE_FOLDER_TABLE, 0);
+	if (!table_object) goto end;
+	table = table_object->object.table;
+	table->prop_count = 1;
+	table->properties = talloc_memdup(table, &proptag, sizeof (enum MAPITAGS));
+	if (!table->properties) goto end;
+	if (emsmdbp_is_mapistore(table_object)) {
+		mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(table_object),
+					    table_object->backend_object, 1, &proptag);
+	}
+
+	for (start = 0; start < table->denominator; start += fetched) {
+		count = table->denominator - start;
+		if (count > EMSMDBP_TABLE_ROW_CACHE_SIZE) {
+			count = EMSMDBP_TABLE_ROW_CACHE_SIZE;
+		}
+		rows = emsmdbp_object_table_get_rows_props(mem_ctx, emsmdbp_ctx, table_object, start, count,
+							   MAPISTORE_PREFILTERED_QUERY, &fetched);
+		for (i = 0; i < fetched; i++) {
+			if (rows[i].retvals[0] == MAPI_E_SUCCESS) {
+				emsmdbp_search_collect_folders(emsmdbp_ctx, context_object, search,
+							       *(uint64_t *)rows[i].data_pointers[0], depth + 1);
+			}
+		}
+		talloc_free(rows);
+		/* Skip the row that could not be read */
+		if (!fetched) fetched = 1;
+	}
+
+end:
+	talloc_free(mem_ctx);
+}
+
+
+/**
+   \details Tell whether a message of an opened folder matches the search
+   restriction
+ */
+static bool emsmdbp_search_match_message(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder,
+					 struct emsmdbp_search_folder *search, uint64_t fid, uint64_t mid)
+{
+	enum mapistore_error		ret;
+	struct emsmdbp_object		*message = NULL;
+	struct emsmdbp_object_table	row;
+	enum MAPISTATUS			*retvals = NULL;
+	void				**data_pointers;
+
+	ret = emsmdbp_object_message_open(mem_ctx, emsmdbp_ctx, folder, fid, mid, false, &message, NULL);
+	if (ret != MAPISTORE_SUCCESS) return false;
+
+	/* Match on the message properties as on a row of those columns */
+	memset(&row, 0, sizeof (row));
+	row.prop_count = search->proptags->cValues;
+	row.properties = search->proptags->aulPropTag;
+	data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, message, search->proptags, &retvals);
+
+	return (data_pointers && emsmdbp_object_table_row_match(&row, search->program, data_pointers, retvals));
+}
+
+
+/**
+   \details Evaluate a single message against the search restriction
+   and add it to or remove it from the search folder
+ */
+static void emsmdbp_search_evaluate(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *context_object,
+				    struct emsmdbp_search_folder *search, uint64_t fid, uint64_t mid)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct emsmdbp_object		*folder = NULL;
+
+	mem_ctx = talloc_new(NULL);
+	if (!mem_ctx) return;
+
+	retval = emsmdbp_object_open_folder_by_fid(mem_ctx, emsmdbp_ctx, context_object, fid, &folder);
+	if (retval == MAPI_E_SUCCESS && emsmdbp_search_match_message(mem_ctx, emsmdbp_ctx, folder, search, fid, mid)) {
+		emsmdbp_search_member_add(search, fid, mid);
+	} else {
+		emsmdbp_search_member_remove(search, fid, mid);
+	}
+
+	talloc_free(mem_ctx);
+}
+
+
+/**
+   \details Add the messages of a folder matching the search
+   restriction to the search folder. When the content index can answer
+   the restriction, only the messages it returns are evaluated.
+ */
+static enum MAPISTATUS emsmdbp_search_scan_folder(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *context_object,
+						  struct emsmdbp_search_folder *search, uint64_t fid)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct emsmdbp_object		*folder = NULL;
+	struct emsmdbp_object		*table_object;
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_table_row_props	*rows;
+	TALLOC_CTX			*message_ctx;
+	uint64_t			*mids;
+	uint32_t			i, start, count, fetched;
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = emsmdbp_object_open_folder_by_fid(mem_ctx, emsmdbp_ctx, context_object, fid, &folder);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	retval = emsmdbp_content_index_candidates(mem_ctx, emsmdbp_ctx, folder, search->res, &mids, &count);
+	if (retval == MAPI_E_SUCCESS) {
+		for (i = 0; i < count; i++) {
+			message_ctx = talloc_new(mem_ctx);
+			if (!message_ctx) break;
+			if (emsmdbp_search_match_message(message_ctx, emsmdbp_ctx, folder, search, fid, mids[i])) {
+				emsmdbp_search_member_add(search, fid, mids[i]);
+			}
+			talloc_free(message_ctx);
+		}
+		talloc_free(mem_ctx);
+		return MAPI_E_SUCCESS;
+	}
+
+	table_object = emsmdbp_folder_open_table(mem_ctx, folder, MAPISTORE_MESSAGE_TABLE, 0);
+	OPENCHANGE_RETVAL_IF(!table_object, MAPI_E_INVALID_OBJECT, mem_ctx);
+	table = table_object->object.table;
+	table->prop_count = search->proptags->cValues;
+	table->properties = talloc_memdup(table, search->proptags->aulPropTag, table->prop_count * sizeof (enum MAPITAGS));
+	OPENCHANGE_RETVAL_IF(!table->properties, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
+	if (emsmdbp_is_mapistore(table_object)) {
+		mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(table_object),
+					    table_object->backend_object, table->prop_count, table->properties);
+	}
+
+	for (start = 0; start < table->denominator; start += fetched) {
+		count = table->denominator - start;
+		if (count > EMSMDBP_TABLE_ROW_CACHE_SIZE) {
+			count = EMSMDBP_TABLE_ROW_CACHE_SIZE;
+		}
+		rows = emsmdbp_object_table_get_rows_props(mem_ctx, emsmdbp_ctx, table_object, start, count,
+							   MAPISTORE_PREFILTERED_QUERY, &fetched);
+		for (i = 0; i < fetched; i++) {
+			if (rows[i].retvals[0] != MAPI_E_SUCCESS) continue;
+			if (emsmdbp_object_table_row_match(table, search->program, rows[i].data_pointers, rows[i].retvals)) {
+				emsmdbp_search_member_add(search, fid, *(uint64_t *)rows[i].data_pointers[0]);
+			}
+		}
+		talloc_free(rows);
+		if (!fetched) fetched = 1;
+	}
+	talloc_free(mem_ctx);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Bring the membership of a search folder up to date: search
+   the folders if it was never done in this session, otherwise apply
+   the queued changes
+
+   \return true if the membership may have changed
+ */
+static bool emsmdbp_search_refresh(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *context_object,
+				   struct emsmdbp_search_folder *search)
+{
+	struct emsmdbp_search_change	*changes;
+	enum MAPISTATUS			retval;
+	uint32_t			i, change_count;
+
+	if (!search->program) return false;
+
+	if (!search->complete) {
+		emsmdbp_search_reset(search);
+		for (i = 0; i < search->scope_count; i++) {
+			emsmdbp_search_collect_folders(emsmdbp_ctx, context_object, search, search->scope[i], 0);
+		}
+		for (i = 0; i < search->folder_count; i++) {
+			retval = emsmdbp_search_scan_folder(emsmdbp_ctx, context_object, search, search->folders[i]);
+			if (retval) {
+				OC_DEBUG(5, "unable to search folder 0x%"PRIx64": %s", search->folders[i], mapi_get_errstr(retval));
+			}
+		}
+		search->complete = true;
+		OC_DEBUG(5, "search folder 0x%"PRIx64": %d messages in %d folders", search->fid, search->count, search->folder_count);
+		return true;
+	}
+
+	if (!search->change_count) return false;
+
+	/* Changes queued while applying these are kept for the next refresh */
+	changes = search->changes;
+	change_count = search->change_count;
+	search->changes = NULL;
+	search->change_count = 0;
+	for (i = 0; i < change_count; i++) {
+		if (!changes[i].mid) {
+			emsmdbp_search_folder_members_remove(search, changes[i].fid);
+			emsmdbp_search_scan_folder(emsmdbp_ctx, context_object, search, changes[i].fid);
+		} else {
+			emsmdbp_search_evaluate(emsmdbp_ctx, context_object, search, changes[i].fid, changes[i].mid);
+		}
+	}
+	talloc_free(changes);
+
+	return true;
+}
+
+
+/**
+   \details Retrieve the search folder state of a folder, with its
+   membership up to date
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder pointer to the search folder object
+   \param searchp pointer on pointer to the search folder to return
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT if the folder is
+   not a search folder, MAPI_E_NOT_INITIALIZED if its search criteria
+   were never set, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_search_get(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder,
+					    struct emsmdbp_search_folder **searchp)
+{
+	enum MAPISTATUS			retval;
+	struct emsmdbp_search_folder	*search;
+	const char			*owner;
+	uint64_t			fid;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!folder || !searchp, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(folder->type != EMSMDBP_OBJECT_FOLDER, MAPI_E_NO_SUPPORT, NULL);
+
+	/* Search folders live in openchangedb, under the Finder */
+	OPENCHANGE_RETVAL_IF(emsmdbp_is_mapistore(folder), MAPI_E_NO_SUPPORT, NULL);
+
+	owner = emsmdbp_get_owner(folder);
+	OPENCHANGE_RETVAL_IF(!owner, MAPI_E_NO_SUPPORT, NULL);
+	fid = folder->object.folder->folderID;
+
+	search = emsmdbp_search_find(emsmdbp_ctx, owner, fid);
+	if (!search) {
+		retval = emsmdbp_search_load(emsmdbp_ctx, owner, fid, &search);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+	OPENCHANGE_RETVAL_IF(!search->program, MAPI_E_NOT_INITIALIZED, NULL);
+
+	emsmdbp_search_refresh(emsmdbp_ctx, folder, search);
+	*searchp = search;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Set the search criteria of a search folder
+
+   The criteria are stored in openchangedb. Unless the search is
+   stopped, the folders are searched again right away when the criteria
+   change.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param folder pointer to the search folder object
+   \param request pointer to the SetSearchCriteria request
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NO_SUPPORT if the folder is
+   not a search folder, MAPI_E_TOO_COMPLEX if the restriction can not
+   be evaluated, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsmdbp_search_set_criteria(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *folder,
+						     const struct SetSearchCriteria_req *request)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct emsmdbp_search_folder	*search;
+	struct mapiproxy_restriction	*program;
+	struct SRow			row;
+	struct SPropValue		prop;
+	DATA_BLOB			blob, old_blob;
+	const char			*owner;
+	const uint64_t			*scope;
+	uint16_t			scope_count;
+	uint32_t			flags;
+	bool				unchanged = false;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!folder || !request, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(folder->type != EMSMDBP_OBJECT_FOLDER, MAPI_E_NO_SUPPORT, NULL);
+	OPENCHANGE_RETVAL_IF(emsmdbp_is_mapistore(folder), MAPI_E_NO_SUPPORT, NULL);
+
+	owner = emsmdbp_get_owner(folder);
+	OPENCHANGE_RETVAL_IF(!owner, MAPI_E_NO_SUPPORT, NULL);
+
+	search = emsmdbp_search_find(emsmdbp_ctx, owner, folder->object.folder->folderID);
+	if (!search) {
+		retval = emsmdbp_search_load(emsmdbp_ctx, owner, folder->object.folder->folderID, &search);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	/* Folders are only given when they change */
+	if (request->FolderIdCount) {
+		scope_count = request->FolderIdCount;
+		scope = request->FolderIds;
+	} else {
+		scope_count = search->scope_count;
+		scope = search->scope;
+	}
+	OPENCHANGE_RETVAL_IF(!scope_count, MAPI_E_INVALID_PARAMETER, NULL);
+
+	flags = search->program ? search->flags : 0;
+	if (request->SearchFlags & RECURSIVE_SEARCH) {
+		flags |= RECURSIVE_SEARCH;
+	} else if (request->SearchFlags & SHALLOW_SEARCH) {
+		flags &= ~RECURSIVE_SEARCH;
+	}
+	if (request->SearchFlags & STOP_SEARCH) {
+		flags |= STOP_SEARCH;
+	} else if (request->SearchFlags & RESTART_SEARCH) {
+		flags &= ~STOP_SEARCH;
+	}
+	flags = (flags & ~STATIC_SEARCH) | (request->SearchFlags & STATIC_SEARCH);
+
+	mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	/* Reject what can not be evaluated before storing anything */
+	retval = mapiproxy_restriction_compile(mem_ctx, &request->res, &program);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	retval = emsmdbp_search_criteria_pack(mem_ctx, flags, &request->res, scope_count, scope, &blob);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	/* Stopping or resuming a search keeps its results */
+	if (search->program && !(request->SearchFlags & RESTART_SEARCH)) {
+		retval = emsmdbp_search_criteria_pack(mem_ctx, flags, search->res, search->scope_count, search->scope, &old_blob);
+		unchanged = (retval == MAPI_E_SUCCESS && data_blob_cmp(&blob, &old_blob) == 0);
+	}
+
+	memset(&prop, 0, sizeof (prop));
+	prop.ulPropTag = EMSMDBP_SEARCH_CRITERIA_PROPTAG;
+	prop.value.bin.cb = blob.length;
+	prop.value.bin.lpb = blob.data;
+	row.cValues = 1;
+	row.lpProps = &prop;
+	retval = openchangedb_set_folder_properties(emsmdbp_ctx->oc_ctx, owner, search->fid, &row);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
+	retval = emsmdbp_search_criteria_unpack(search, &blob);
+	talloc_free(mem_ctx);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	if (!unchanged) {
+		emsmdbp_search_reset(search);
+	}
+	if (!(search->flags & STOP_SEARCH)) {
+		emsmdbp_search_refresh(emsmdbp_ctx, folder, search);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Return the state of a search folder as reported by
+   RopGetSearchCriteria
+
+   \param search pointer to the search folder
+
+   \return the SEARCH_* state flags
+ */
+_PUBLIC_ uint32_t emsmdbp_search_get_state(const struct emsmdbp_search_folder *search)
+{
+	uint32_t	state = 0;
+
+	if (!search) return 0;
+
+	if (!(search->flags & STOP_SEARCH)) {
+		state |= EMSMDBP_SEARCH_RUNNING;
+	}
+	if (search->flags & RECURSIVE_SEARCH) {
+		state |= EMSMDBP_SEARCH_RECURSIVE;
+	}
+	if (search->flags & STATIC_SEARCH) {
+		state |= EMSMDBP_SEARCH_STATIC;
+	}
+	if (search->complete) {
+		state |= EMSMDBP_SEARCH_COMPLETE;
+	}
+
+	return state;
+}
+
+
+/**
+   \details Bring a search folder contents table up to date with the
+   search folder membership
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the contents table object
+ */
+_PUBLIC_ void emsmdbp_search_table_refresh(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *table_object)
+{
+	struct emsmdbp_object_table	*table;
+
+	if (!emsmdbp_ctx || !table_object || table_object->type != EMSMDBP_OBJECT_TABLE) return;
+
+	table = table_object->object.table;
+	if (!table->search) return;
+
+	if (emsmdbp_search_refresh(emsmdbp_ctx, table_object->parent_object, table->search)) {
+		emsmdbp_object_table_cache_reset(table);
+	}
+	table->denominator = table->search->count;
+	if (table->numerator > table->denominator) {
+		table->numerator = table->denominator;
+	}
+}
+
+
+/**
+   \details Retrieve a row of a search folder contents table, read from
+   the member message
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param table_object pointer to the contents table object
+   \param row_id the row position
+   \param retvalsp pointer on pointer to the row retvals to return
+
+   \return Allocated row values on success, otherwise NULL
+ */
+_PUBLIC_ void **emsmdbp_search_get_row_props(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+					     struct emsmdbp_object *table_object, uint32_t row_id,
+					     enum MAPISTATUS **retvalsp)
+{
+	TALLOC_CTX			*local_mem_ctx;
+	enum MAPISTATUS			retval;
+	enum mapistore_error		ret;
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_search_member	*member;
+	struct emsmdbp_object		*folder = NULL;
+	struct emsmdbp_object		*message = NULL;
+	struct SPropTagArray		props;
+	void				**data_pointers;
+
+	table = table_object->object.table;
+	if (!table->search || row_id >= table->search->count) return NULL;
+	member = &table->search->members[row_id];
+
+	local_mem_ctx = talloc_new(NULL);
+	if (!local_mem_ctx) return NULL;
+
+	retval = emsmdbp_object_open_folder_by_fid(local_mem_ctx, emsmdbp_ctx, table_object->parent_object, member->fid, &folder);
+	if (retval) goto fail;
+
+	ret = emsmdbp_object_message_open(local_mem_ctx, emsmdbp_ctx, folder, member->fid, member->mid, false, &message, NULL);
+	if (ret != MAPISTORE_SUCCESS) goto fail;
+
+	props.cValues = table->prop_count;
+	props.aulPropTag = table->properties;
+	data_pointers = emsmdbp_object_get_properties(mem_ctx, emsmdbp_ctx, message, &props, retvalsp);
+	if (!data_pointers) goto fail;
+
+	/* The values may be owned by the message */
+	talloc_steal(data_pointers, local_mem_ctx);
+
+	return data_pointers;
+
+fail:
+	OC_DEBUG(5, "unable to read message 0x%"PRIx64" of search folder 0x%"PRIx64, member->mid, table->search->fid);
+	talloc_free(local_mem_ctx);
+	return NULL;
+}
+
+
+/**
+   \details Queue a message for a new evaluation by the search folders
+   of the session which search its folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param fid the folder of the message
+   \param mid the message identifier, 0 when any message of the folder
+   may have changed
+ */
+_PUBLIC_ void emsmdbp_search_message_changed(struct emsmdbp_context *emsmdbp_ctx, uint64_t fid, uint64_t mid)
+{
+	struct emsmdbp_search_folder	*search;
+
+	if (!emsmdbp_ctx) return;
+
+	for (search = emsmdbp_ctx->search_folders; search; search = search->next) {
+		if (!search->complete || (search->flags & (STOP_SEARCH|STATIC_SEARCH))) continue;
+		if (!emsmdbp_search_in_scope(search, fid)) continue;
+		emsmdbp_search_queue(search, fid, mid);
+	}
+}
+
+
+/**
+   \details Queue a message object saved or flagged by the session for
+   a new evaluation
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message pointer to the message object
+ */
+_PUBLIC_ void emsmdbp_search_message_saved(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *message)
+{
+	if (!emsmdbp_ctx || !emsmdbp_ctx->search_folders || !message || message->type != EMSMDBP_OBJECT_MESSAGE) return;
+	if (!message->parent_object || message->parent_object->type != EMSMDBP_OBJECT_FOLDER) return;
+
+	emsmdbp_search_message_changed(emsmdbp_ctx, message->parent_object->object.folder->folderID,
+				       message->object.message->messageID);
+}
+
+
+/**
+   \details Remove a deleted message from the search folders of the
+   session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param fid the folder of the message
+   \param mid the message identifier
+ */
+_PUBLIC_ void emsmdbp_search_message_removed(struct emsmdbp_context *emsmdbp_ctx, uint64_t fid, uint64_t mid)
+{
+	struct emsmdbp_search_folder	*search;
+
+	if (!emsmdbp_ctx) return;
+
+	for (search = emsmdbp_ctx->search_folders; search; search = search->next) {
+		emsmdbp_search_member_remove(search, fid, mid);
+	}
+}
+
+
+/**
+   \details Update the search folders of the session from an object
+   notification delivered to it
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param notify pointer to the notification
+ */
+_PUBLIC_ void emsmdbp_search_notify(struct emsmdbp_context *emsmdbp_ctx, const struct Notify_repl *notify)
+{
+	const union NotificationData	*data;
+	struct emsmdbp_search_folder	*search;
+
+	if (!emsmdbp_ctx || !notify || !emsmdbp_ctx->search_folders) return;
+
+	data = &notify->NotificationData;
+	switch (notify->NotificationType) {
+	case 0x0002: /* new mail */
+	case 0x8002:
+		emsmdbp_search_message_changed(emsmdbp_ctx, data->NewMailNotification.FID, data->NewMailNotification.MID);
+		break;
+	case 0x8004: /* message created */
+		emsmdbp_search_message_changed(emsmdbp_ctx, data->MessageCreatedNotification.FID, data->MessageCreatedNotification.MID);
+		break;
+	case 0x8010: /* message modified */
+		emsmdbp_search_message_changed(emsmdbp_ctx, data->MessageModifiedNotification.FID, data->MessageModifiedNotification.MID);
+		break;
+	case 0x8008: /* message deleted */
+		emsmdbp_search_message_removed(emsmdbp_ctx, data->MessageDeletedNotification.FID, data->MessageDeletedNotification.MID);
+		break;
+	case 0x8020: /* message moved */
+		emsmdbp_search_message_removed(emsmdbp_ctx, data->MessageMoveNotification.OldFID, data->MessageMoveNotification.OldMID);
+		emsmdbp_search_message_changed(emsmdbp_ctx, data->MessageMoveNotification.FID, data->MessageMoveNotification.MID);
+		break;
+	case 0x8040: /* message copied */
+		emsmdbp_search_message_changed(emsmdbp_ctx, data->MessageCopyNotification.FID, data->MessageCopyNotification.MID);
+		break;
+	case 0x8100: /* contents table changed */
+		switch (data->ContentsTableChange.TableEvent) {
+		case TABLE_ROW_ADDED:
+			emsmdbp_search_message_changed(emsmdbp_ctx, data->ContentsTableChange.ContentsTableChangeUnion.ContentsRowAddedNotification.FID,
+						       data->ContentsTableChange.ContentsTableChangeUnion.ContentsRowAddedNotification.MID);
+			break;
+		case TABLE_ROW_MODIFIED:
+			emsmdbp_search_message_changed(emsmdbp_ctx, data->ContentsTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification.FID,
+						       data->ContentsTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification.MID);
+			break;
+		case TABLE_ROW_DELETED:
+			emsmdbp_search_message_removed(emsmdbp_ctx, data->ContentsTableChange.ContentsTableChangeUnion.ContentsRowDeletedNotification.FID,
+						       data->ContentsTableChange.ContentsTableChangeUnion.ContentsRowDeletedNotification.MID);
+			break;
+		default:
+			break;
+		}
+		break;
+	case 0x0004: /* folder created */
+		for (search = emsmdbp_ctx->search_folders; search; search = search->next) {
+			if (!search->complete || (search->flags & (STOP_SEARCH|STATIC_SEARCH|RECURSIVE_SEARCH)) != RECURSIVE_SEARCH) continue;
+			if (!emsmdbp_search_in_scope(search, data->FolderCreatedNotification.ParentFID) ||
+			    emsmdbp_search_in_scope(search, data->FolderCreatedNotification.FID)) continue;
+			/* Searched once its contents are known, on the next refresh */
+			search->folders = talloc_realloc(search, search->folders, uint64_t, search->folder_count + 1);
+			if (!search->folders) {
+				search->folder_count = 0;
+				search->complete = false;
+				continue;
+			}
+			search->folders[search->folder_count++] = data->FolderCreatedNotification.FID;
+			emsmdbp_search_queue(search, data->FolderCreatedNotification.FID, 0);
+		}
+		break;
+	case 0x0008: /* folder deleted */
+		for (search = emsmdbp_ctx->search_folders; search; search = search->next) {
+			emsmdbp_search_folder_members_remove(search, data->FolderDeletedNotification.FID);
+		}
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,240 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_stats.c
+
+   \brief Per-ROP counters and latency histograms
+
+   When emsmdb:rop_stats is enabled, every worker process maps a file
+   named emsmdb-<pid>.stats in emsmdb:rop_stats_dir and accounts each
+   ROP it processes there: calls, failures, total and maximum latency
+   and a histogram of latencies with power of two buckets. It also
+   holds the memory gauge of every session the worker hosts and the
+   number of emsmdbp objects of each type. The file layout is struct
+   emsmdbp_stats, readers such as script/emsmdb_stats.py can open it at
+   any time while the worker updates it in place.
+ */
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Statistics of the current worker, NULL when disabled */
+static struct emsmdbp_stats	*emsmdbp_stats = NULL;
+static bool			emsmdbp_stats_initialized = false;
+
+
+/**
+   \details Map the statistics of the current worker, if enabled
+
+   \param lp_ctx pointer to the loadparm context
+
+   \return true if statistics are enabled, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_stats_init(struct loadparm_context *lp_ctx)
+{
+	const char	*dir;
+	char		*path;
+	int		fd;
+	void		*addr;
+
+	if (emsmdbp_stats_initialized) {
+		return (emsmdbp_stats != NULL);
+	}
+	emsmdbp_stats_initialized = true;
+
+	if (!lpcfg_parm_bool(lp_ctx, NULL, "emsmdb", "rop_stats", false)) {
+		return false;
+	}
+
+	dir = lpcfg_parm_string(lp_ctx, NULL, "emsmdb", "rop_stats_dir");
+	if (!dir) {
+		dir = lpcfg_lock_directory(lp_ctx);
+	}
+
+	path = talloc_asprintf(NULL, "%s/emsmdb-%d.stats", dir, (int)getpid());
+	if (!path) return false;
+
+	fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	if (fd == -1) {
+		OC_DEBUG(0, "Unable to open ROP statistics file %s: %s", path, strerror(errno));
+		talloc_free(path);
+		return false;
+	}
+
+	if (ftruncate(fd, sizeof (struct emsmdbp_stats)) == -1) {
+		OC_DEBUG(0, "Unable to size ROP statistics file %s: %s", path, strerror(errno));
+		close(fd);
+		talloc_free(path);
+		return false;
+	}
+
+	addr = mmap(NULL, sizeof (struct emsmdbp_stats), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		OC_DEBUG(0, "Unable to map ROP statistics file %s: %s", path, strerror(errno));
+		talloc_free(path);
+		return false;
+	}
+
+	emsmdbp_stats = (struct emsmdbp_stats *) addr;
+	emsmdbp_stats->pid = getpid();
+	emsmdbp_stats->buckets = EMSMDBP_STATS_BUCKETS;
+	emsmdbp_stats->started = time(NULL);
+	emsmdbp_stats->version = EMSMDBP_STATS_VERSION;
+	/* Readers only trust the file once the magic is set */
+	emsmdbp_stats->magic = EMSMDBP_STATS_MAGIC;
+
+	OC_DEBUG(3, "ROP statistics written to %s", path);
+	talloc_free(path);
+
+	return true;
+}
+
+
+/**
+   \details Return whether ROP statistics are enabled for the current
+   worker
+ */
+_PUBLIC_ bool emsmdbp_stats_enabled(void)
+{
+	return (emsmdbp_stats != NULL);
+}
+
+
+/**
+   \details Take the timestamp a ROP latency is measured from
+
+   \param start pointer to the timestamp to fill
+ */
+_PUBLIC_ void emsmdbp_stats_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+
+/**
+   \details Account a processed ROP
+
+   \param opnum the ROP identifier
+   \param failed whether the ROP failed
+   \param start pointer to the timestamp taken with
+   emsmdbp_stats_start before processing the ROP
+ */
+_PUBLIC_ void emsmdbp_stats_rop(uint8_t opnum, bool failed, const struct timespec *start)
+{
+	struct emsmdbp_rop_stats	*rop;
+	struct timespec			end;
+	uint64_t			usec;
+	uint32_t			bucket;
+
+	if (!emsmdbp_stats) return;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	usec = (uint64_t)(end.tv_sec - start->tv_sec) * 1000000 +
+		(end.tv_nsec - start->tv_nsec) / 1000;
+
+	/* Bucket 0 holds latencies under 1us, bucket b those in
+	 * [2^(b-1), 2^b) us and the last one everything above */
+	for (bucket = 0; bucket < EMSMDBP_STATS_BUCKETS - 1 && (usec >> bucket); bucket++);
+
+	rop = &emsmdbp_stats->rops[opnum];
+	rop->count++;
+	if (failed) {
+		rop->errors++;
+	}
+	rop->total_usec += usec;
+	if (usec > rop->max_usec) {
+		rop->max_usec = usec;
+	}
+	rop->buckets[bucket]++;
+}
+
+
+/**
+   \details Reserve the memory gauge of a session
+
+   \param username the account name of the session
+
+   \return the gauge on success, NULL when statistics are disabled or
+   all the slots are taken
+ */
+_PUBLIC_ struct emsmdbp_session_stats *emsmdbp_stats_session_get(const char *username)
+{
+	struct emsmdbp_session_stats	*session;
+	uint32_t			i;
+
+	if (!emsmdbp_stats) return NULL;
+
+	for (i = 0; i < EMSMDBP_STATS_SESSIONS; i++) {
+		session = &emsmdbp_stats->sessions[i];
+		if (session->in_use) continue;
+
+		memset(session, 0, sizeof (struct emsmdbp_session_stats));
+		if (username) {
+			strncpy(session->username, username, sizeof (session->username) - 1);
+		}
+		session->in_use = 1;
+		return session;
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Release the memory gauge of a session
+
+   \param session pointer to the gauge returned by
+   emsmdbp_stats_session_get
+ */
+_PUBLIC_ void emsmdbp_stats_session_release(struct emsmdbp_session_stats *session)
+{
+	if (!session) return;
+
+	memset(session, 0, sizeof (struct emsmdbp_session_stats));
+}
+
+
+/**
+   \details Account an emsmdbp object created or released
+
+   \param type the type of the object
+   \param created whether the object is created or released
+ */
+_PUBLIC_ void emsmdbp_stats_object(enum emsmdbp_object_type type, bool created)
+{
+	struct emsmdbp_object_stats	*objects;
+
+	if (!emsmdbp_stats || type >= EMSMDBP_STATS_OBJECT_TYPES) return;
+
+	objects = &emsmdbp_stats->objects[type];
+	if (created) {
+		objects->live++;
+		objects->created++;
+	} else if (objects->live) {
+		objects->live--;
+	}
+}
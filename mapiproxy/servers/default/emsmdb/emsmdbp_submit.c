@@ -0,0 +1,242 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_submit.c
+
+   \brief Deferred submission of messages
+
+   Submitting a message hands it over to the backend, which usually
+   sends it by SMTP, and then stores its copy in the Sent Items
+   folder. When emsmdb:async_submit is set, SubmitMessage only queues
+   the message on the session and returns: the submission is done from
+   a timer of the server event loop, once the reply has been sent.
+   A submission refused by the backend is retried
+   emsmdb:submit_retries times, waiting longer each time, and the
+   message stays in the Outbox when it is still refused. The message
+   object is kept alive by the queue, even if the client releases it.
+   Whatever is still queued when the session ends is submitted before
+   the mapistore context is released.
+
+   The notifications of the Sent Items and Outbox folders are
+   raised by the backend as usual, once the message is moved.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Delay before the first attempt, in microseconds */
+#define	EMSMDBP_SUBMIT_DELAY		10000
+
+/* Delay before the first retry, in seconds, doubled on each retry */
+#define	EMSMDBP_SUBMIT_RETRY_DELAY	15
+
+struct emsmdbp_submit {
+	struct emsmdbp_submit		*prev;
+	struct emsmdbp_submit		*next;
+	struct emsmdbp_object		*message_object;
+	uint8_t				flags;
+	uint32_t			attempts;
+	struct timeval			not_before;
+};
+
+static void emsmdbp_submit_handler(struct tevent_context *, struct tevent_timer *, struct timeval, void *);
+
+
+/**
+   \details Submit a queued message to its backend and move it to the
+   Sent Items folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param entry the queued message
+   \param retries the number of retries allowed after a failure
+
+   \return true if the message must be retried later, otherwise false
+ */
+static bool emsmdbp_submit_process(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_submit *entry, uint32_t retries)
+{
+	struct emsmdbp_object	*object = entry->message_object;
+	enum mapistore_error	ret;
+	uint32_t		contextID;
+	uint64_t		messageID;
+	char			*owner;
+
+	contextID = emsmdbp_get_contextID(object);
+	messageID = object->object.message->messageID;
+	owner = emsmdbp_get_owner(object);
+
+	ret = mapistore_message_submit(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, entry->flags);
+	entry->attempts++;
+	if (ret != MAPISTORE_SUCCESS) {
+		if (entry->attempts <= retries) {
+			OC_DEBUG(3, "submission of message 0x%.16"PRIx64" of %s failed (%s), attempt %"PRIu32" of %"PRIu32"\n",
+				 messageID, owner, mapistore_errstr(ret), entry->attempts, retries + 1);
+			entry->not_before = tevent_timeval_current_ofs(EMSMDBP_SUBMIT_RETRY_DELAY << (entry->attempts - 1), 0);
+			return true;
+		}
+		OC_DEBUG(1, "submission of message 0x%.16"PRIx64" of %s failed (%s), giving up\n",
+			 messageID, owner, mapistore_errstr(ret));
+		return false;
+	}
+
+	oxomsg_mapistore_handle_message_relocation(emsmdbp_ctx, object);
+	mapistore_indexing_record_add_mid(emsmdbp_ctx->mstore_ctx, contextID, owner, messageID);
+
+	return false;
+}
+
+
+/**
+   \details Submit the queued messages whose time has come
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param retries the number of retries allowed after a failure
+   \param all whether the messages waiting for a retry are submitted too
+ */
+static void emsmdbp_submit_step(struct emsmdbp_context *emsmdbp_ctx, uint32_t retries, bool all)
+{
+	struct emsmdbp_submit	*entry;
+	struct emsmdbp_submit	*next;
+	struct timeval		now;
+
+	now = tevent_timeval_current();
+	for (entry = emsmdbp_ctx->submits; entry; entry = next) {
+		next = entry->next;
+		if (!all && tevent_timeval_compare(&entry->not_before, &now) > 0) {
+			continue;
+		}
+		if (emsmdbp_submit_process(emsmdbp_ctx, entry, retries)) {
+			continue;
+		}
+		DLIST_REMOVE(emsmdbp_ctx->submits, entry);
+		talloc_free(entry);
+	}
+}
+
+
+/**
+   \details Arm the timer of the next queued message
+ */
+static void emsmdbp_submit_schedule(struct emsmdbp_context *emsmdbp_ctx)
+{
+	struct emsmdbp_submit	*entry;
+	struct timeval		next;
+
+	if (emsmdbp_ctx->submit_timer) {
+		talloc_free(emsmdbp_ctx->submit_timer);
+		emsmdbp_ctx->submit_timer = NULL;
+	}
+	if (!emsmdbp_ctx->submits) return;
+
+	next = emsmdbp_ctx->submits->not_before;
+	for (entry = emsmdbp_ctx->submits->next; entry; entry = entry->next) {
+		if (tevent_timeval_compare(&entry->not_before, &next) < 0) {
+			next = entry->not_before;
+		}
+	}
+
+	emsmdbp_ctx->submit_timer = tevent_add_timer(emsmdbp_ctx->ev_ctx, emsmdbp_ctx, next,
+						     emsmdbp_submit_handler, emsmdbp_ctx);
+	if (!emsmdbp_ctx->submit_timer) {
+		OC_DEBUG(1, "unable to schedule message submission, submitting now\n");
+		emsmdbp_submit_flush(emsmdbp_ctx);
+	}
+}
+
+
+static void emsmdbp_submit_handler(struct tevent_context *ev, struct tevent_timer *te,
+				   struct timeval current_time, void *private_data)
+{
+	struct emsmdbp_context	*emsmdbp_ctx = talloc_get_type_abort(private_data, struct emsmdbp_context);
+	int			retries;
+
+	/* the timer is freed by tevent once it fired */
+	emsmdbp_ctx->submit_timer = NULL;
+
+	retries = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "submit_retries", 3);
+	emsmdbp_submit_step(emsmdbp_ctx, retries > 0 ? retries : 0, false);
+	emsmdbp_submit_schedule(emsmdbp_ctx);
+}
+
+
+/**
+   \details Queue a message for submission when emsmdb:async_submit is
+   set
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param message_object the message to submit
+   \param flags the SubmitMessage flags
+
+   \return true if the message is queued, false if it has to be
+   submitted by the caller
+ */
+_PUBLIC_ bool emsmdbp_submit_queue(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *message_object, uint8_t flags)
+{
+	struct emsmdbp_submit	*entry;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !message_object || message_object->type != EMSMDBP_OBJECT_MESSAGE) return false;
+
+	/* The timer can't be driven from the worker threads: the call
+	 * doesn't block the event loop there anyway */
+	if (!lpcfg_parm_bool(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "async_submit", false) ||
+	    !emsmdbp_ctx->ev_ctx || emsmdbp_threads_enabled()) {
+		return false;
+	}
+
+	entry = talloc_zero(emsmdbp_ctx, struct emsmdbp_submit);
+	if (!entry) return false;
+
+	/* The message must outlive its handle */
+	if (!talloc_reference(entry, message_object)) {
+		talloc_free(entry);
+		return false;
+	}
+	entry->message_object = message_object;
+	entry->flags = flags;
+	entry->not_before = tevent_timeval_current_ofs(0, EMSMDBP_SUBMIT_DELAY);
+
+	DLIST_ADD_END(emsmdbp_ctx->submits, entry, struct emsmdbp_submit *);
+	OC_DEBUG(5, "submission of message 0x%.16"PRIx64" queued\n", message_object->object.message->messageID);
+
+	emsmdbp_submit_schedule(emsmdbp_ctx);
+
+	return true;
+}
+
+
+/**
+   \details Submit all the queued messages now, without retrying those
+   refused by their backend
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+ */
+_PUBLIC_ void emsmdbp_submit_flush(struct emsmdbp_context *emsmdbp_ctx)
+{
+	if (!emsmdbp_ctx) return;
+
+	if (emsmdbp_ctx->submit_timer) {
+		talloc_free(emsmdbp_ctx->submit_timer);
+		emsmdbp_ctx->submit_timer = NULL;
+	}
+
+	emsmdbp_submit_step(emsmdbp_ctx, 0, true);
+}
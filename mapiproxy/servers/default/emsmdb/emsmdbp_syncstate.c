@@ -0,0 +1,152 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_syncstate.c
+
+   \brief Uploaded synchronization states
+
+   Clients upload their synchronization state before each ICS cycle,
+   and poll the same folders with the same state until something
+   changes. The idsets parsed and validated from an uploaded state are
+   kept on the session, keyed by the state property and the uploaded
+   bytes, so that the same upload is not parsed and checked again.
+
+   Only validated states are kept. Change number sets are checked
+   against the next change number, which only grows: a set valid once
+   stays valid.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+/* Number of uploaded states kept on a session */
+#define	EMSMDBP_SYNCSTATE_CACHE_SIZE	32
+
+static uint32_t emsmdbp_syncstate_hash(uint32_t state_property, const DATA_BLOB *buffer)
+{
+	uint32_t	hash = 2166136261U;
+	size_t		i;
+
+	hash = (hash ^ state_property) * 16777619U;
+	for (i = 0; i < buffer->length; i++) {
+		hash = (hash ^ buffer->data[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+static struct emsmdbp_syncstate *emsmdbp_syncstate_find(struct emsmdbp_context *emsmdbp_ctx, uint32_t state_property,
+							const DATA_BLOB *buffer, uint32_t hash, uint32_t *cachedp)
+{
+	struct emsmdbp_syncstate	*syncstate;
+
+	*cachedp = 0;
+	for (syncstate = emsmdbp_ctx->syncstates; syncstate; syncstate = syncstate->next) {
+		if (syncstate->hash == hash && syncstate->state_property == state_property
+		    && syncstate->buffer.length == buffer->length
+		    && !memcmp(syncstate->buffer.data, buffer->data, buffer->length)) {
+			return syncstate;
+		}
+		(*cachedp)++;
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Retrieve the idset parsed from an uploaded state which was
+   already uploaded in this session
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param state_property the meta property the state was uploaded for
+   \param buffer the uploaded bytes
+
+   \return a copy of the idset owned by mem_ctx if the state is known,
+   otherwise NULL
+ */
+_PUBLIC_ struct idset *emsmdbp_syncstate_lookup(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx,
+						uint32_t state_property, const DATA_BLOB *buffer)
+{
+	struct emsmdbp_syncstate	*syncstate;
+	uint32_t			cached;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !buffer || !buffer->length) return NULL;
+
+	syncstate = emsmdbp_syncstate_find(emsmdbp_ctx, state_property, buffer,
+					   emsmdbp_syncstate_hash(state_property, buffer), &cached);
+	if (!syncstate) return NULL;
+
+	/* most recently used first */
+	if (syncstate != emsmdbp_ctx->syncstates) {
+		DLIST_REMOVE(emsmdbp_ctx->syncstates, syncstate);
+		DLIST_ADD(emsmdbp_ctx->syncstates, syncstate);
+	}
+
+	return IDSET_clone(mem_ctx, syncstate->idset);
+}
+
+
+/**
+   \details Keep the idset parsed and validated from an uploaded state
+   on the session
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param state_property the meta property the state was uploaded for
+   \param buffer the uploaded bytes
+   \param idset the idset parsed from buffer
+ */
+_PUBLIC_ void emsmdbp_syncstate_store(struct emsmdbp_context *emsmdbp_ctx, uint32_t state_property,
+				      const DATA_BLOB *buffer, const struct idset *idset)
+{
+	struct emsmdbp_syncstate	*syncstate;
+	struct emsmdbp_syncstate	*last;
+	uint32_t			hash;
+	uint32_t			cached;
+
+	/* Sanity checks */
+	if (!emsmdbp_ctx || !buffer || !buffer->length || !idset) return;
+
+	hash = emsmdbp_syncstate_hash(state_property, buffer);
+	if (emsmdbp_syncstate_find(emsmdbp_ctx, state_property, buffer, hash, &cached)) return;
+
+	syncstate = talloc_zero(emsmdbp_ctx, struct emsmdbp_syncstate);
+	if (!syncstate) return;
+	syncstate->hash = hash;
+	syncstate->state_property = state_property;
+	syncstate->buffer.data = talloc_memdup(syncstate, buffer->data, buffer->length);
+	syncstate->buffer.length = buffer->length;
+	syncstate->idset = IDSET_clone(syncstate, idset);
+	if (!syncstate->buffer.data || !syncstate->idset) {
+		talloc_free(syncstate);
+		return;
+	}
+
+	if (cached >= EMSMDBP_SYNCSTATE_CACHE_SIZE) {
+		last = DLIST_TAIL(emsmdbp_ctx->syncstates);
+		DLIST_REMOVE(emsmdbp_ctx->syncstates, last);
+		talloc_free(last);
+	}
+	DLIST_ADD(emsmdbp_ctx->syncstates, syncstate);
+}
@@ -0,0 +1,476 @@
+/*
+   OpenChange Server implementation
+
+   EMSMDBP: EMSMDB Provider implementation
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsmdbp_threads.c
+
+   \brief Worker threads for emsmdb calls
+
+   When emsmdb:worker_threads is set, emsmdb calls are run by a pool
+   of worker threads and their DCE/RPC reply is sent asynchronously
+   from the event loop once they complete. Calls made on the same
+   connection are run one at a time and in order.
+
+   The provider, openchangedb, samdb and mapistore share state between
+   the sessions and the servers of a process, so a worker holds the
+   mapiproxy server lock while it runs a call. The lock is only
+   released around the operations of backends flagged
+   MAPISTORE_BACKEND_THREAD_SAFE: while one of them works on a slow
+   mailbox, calls of the other sessions go on. The event loop takes the
+   lock too before it sends the replies or runs a call itself, and so
+   do the nspi and asyncemsmdb servers. As nothing would run
+   concurrently otherwise, the workers are only started when one of the
+   loaded backends is thread safe.
+
+   Calls of connections whose previous call processed bulk ROPs (see
+   emsmdbp_sched.c) are picked after the interactive ones, one bulk
+   call every EMSMDBP_THREADS_BULK_SHARE picks at least so they are
+   never starved. When there are several workers, one of them is kept
+   for interactive calls.
+ */
+
+#include <fcntl.h>
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_emsmdb.h"
+
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
+/* Bulk calls waiting are picked at least once every that many picks */
+#define	EMSMDBP_THREADS_BULK_SHARE	4
+
+struct emsmdbp_thread_job {
+	struct emsmdbp_thread_job	*prev;
+	struct emsmdbp_thread_job	*next;
+	struct server_id		server_id;
+	uint32_t			context_id;
+	bool				bulk; /* expected to process bulk ROPs */
+	bool				ran_bulk; /* processed bulk ROPs */
+	void				(*work)(void *);
+	void				(*done)(void *);
+	void				*private_data;
+};
+
+/* A connection whose last call processed bulk ROPs */
+struct emsmdbp_thread_conn {
+	struct emsmdbp_thread_conn	*prev;
+	struct emsmdbp_thread_conn	*next;
+	struct server_id		server_id;
+	uint32_t			context_id;
+};
+
+static bool				emsmdbp_threads_initialized = false;
+static bool				emsmdbp_threads_on = false;
+
+#if defined(HAVE_PTHREADS)
+static __thread struct emsmdbp_thread_job	*job_current = NULL;
+static int				threads_count = 0;
+
+/* Job lists, protected by jobs_lock */
+static pthread_mutex_t			jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t			jobs_cond = PTHREAD_COND_INITIALIZER;
+static struct emsmdbp_thread_job	*jobs_pending = NULL;
+static struct emsmdbp_thread_job	*jobs_running = NULL;
+static struct emsmdbp_thread_job	*jobs_done = NULL;
+static uint32_t				jobs_pending_count = 0;
+static uint32_t				jobs_bulk_running = 0;
+static uint32_t				jobs_interactive_picks = 0;
+static struct emsmdbp_thread_conn	*conns_bulk = NULL;
+
+/* Wakes the event loop up when jobs complete */
+static int				jobs_pipe[2] = { -1, -1 };
+static TALLOC_CTX			*jobs_ctx = NULL;
+
+
+static bool emsmdbp_thread_same_connection(const struct server_id *a_id, uint32_t a_context,
+					   const struct server_id *b_id, uint32_t b_context)
+{
+	return (a_context == b_context &&
+		a_id->pid == b_id->pid &&
+		a_id->task_id == b_id->task_id &&
+		a_id->vnn == b_id->vnn);
+}
+
+static bool emsmdbp_thread_job_same_connection(const struct emsmdbp_thread_job *a, const struct emsmdbp_thread_job *b)
+{
+	return emsmdbp_thread_same_connection(&a->server_id, a->context_id, &b->server_id, b->context_id);
+}
+
+
+/**
+   \details Return the bulk record of a connection. Must be called with
+   jobs_lock held.
+ */
+static struct emsmdbp_thread_conn *emsmdbp_thread_conn_find(const struct server_id *server_id, uint32_t context_id)
+{
+	struct emsmdbp_thread_conn	*conn;
+
+	for (conn = conns_bulk; conn; conn = conn->next) {
+		if (emsmdbp_thread_same_connection(&conn->server_id, conn->context_id, server_id, context_id)) {
+			return conn;
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Remember whether the last job of a connection processed
+   bulk ROPs. Must be called with jobs_lock held.
+ */
+static void emsmdbp_thread_conn_update(const struct emsmdbp_thread_job *job)
+{
+	struct emsmdbp_thread_conn	*conn;
+
+	conn = emsmdbp_thread_conn_find(&job->server_id, job->context_id);
+	if (job->ran_bulk && !conn) {
+		conn = talloc_zero(jobs_ctx, struct emsmdbp_thread_conn);
+		if (!conn) return;
+		conn->server_id = job->server_id;
+		conn->context_id = job->context_id;
+		DLIST_ADD(conns_bulk, conn);
+	} else if (!job->ran_bulk && conn) {
+		DLIST_REMOVE(conns_bulk, conn);
+		talloc_free(conn);
+	}
+}
+
+
+/**
+   \details Return the pending job to run next, among those whose
+   connection has no job running: interactive jobs first, then bulk
+   ones. Must be called with jobs_lock held.
+ */
+static struct emsmdbp_thread_job *emsmdbp_thread_job_next(void)
+{
+	struct emsmdbp_thread_job	*job, *running;
+	struct emsmdbp_thread_job	*interactive = NULL;
+	struct emsmdbp_thread_job	*bulk = NULL;
+	uint32_t			bulk_max;
+
+	for (job = jobs_pending; job && !(interactive && bulk); job = job->next) {
+		if (job->bulk ? bulk != NULL : interactive != NULL) continue;
+		for (running = jobs_running; running; running = running->next) {
+			if (emsmdbp_thread_job_same_connection(job, running)) break;
+		}
+		if (running) continue;
+		if (job->bulk) {
+			bulk = job;
+		} else {
+			interactive = job;
+		}
+	}
+
+	/* Keep a worker for interactive calls */
+	bulk_max = (threads_count > 1) ? threads_count - 1 : 1;
+	if (bulk && jobs_bulk_running >= bulk_max) {
+		bulk = NULL;
+	}
+
+	if (bulk && (!interactive || jobs_interactive_picks >= EMSMDBP_THREADS_BULK_SHARE - 1)) {
+		jobs_interactive_picks = 0;
+		return bulk;
+	}
+	if (interactive && bulk) {
+		jobs_interactive_picks++;
+	}
+
+	return interactive;
+}
+
+
+static void *emsmdbp_thread_main(void *arg)
+{
+	struct emsmdbp_thread_job	*job;
+	ssize_t				ret;
+
+	pthread_mutex_lock(&jobs_lock);
+	while (true) {
+		job = emsmdbp_thread_job_next();
+		if (!job) {
+			pthread_cond_wait(&jobs_cond, &jobs_lock);
+			continue;
+		}
+		DLIST_REMOVE(jobs_pending, job);
+		jobs_pending_count--;
+		mapiproxy_stats_add(MAPIPROXY_STATS_EMSMDB_JOBS, -1);
+		if (job->bulk) {
+			jobs_bulk_running++;
+		}
+		DLIST_ADD_END(jobs_running, job, struct emsmdbp_thread_job *);
+		pthread_mutex_unlock(&jobs_lock);
+
+		mapiproxy_server_lock();
+		job_current = job;
+		job->work(job->private_data);
+		job_current = NULL;
+		mapiproxy_server_unlock();
+
+		pthread_mutex_lock(&jobs_lock);
+		if (job->bulk) {
+			jobs_bulk_running--;
+		}
+		emsmdbp_thread_conn_update(job);
+		DLIST_REMOVE(jobs_running, job);
+		DLIST_ADD_END(jobs_done, job, struct emsmdbp_thread_job *);
+		do {
+			ret = write(jobs_pipe[1], "", 1);
+		} while (ret == -1 && errno == EINTR);
+		/* Jobs of this connection may run now */
+		pthread_cond_broadcast(&jobs_cond);
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Run the completion of the jobs done by the workers, from
+   the event loop
+ */
+static void emsmdbp_threads_done_handler(struct tevent_context *ev, struct tevent_fd *fde,
+					 uint16_t flags, void *private_data)
+{
+	struct emsmdbp_thread_job	*jobs, *job;
+	char				buf[64];
+
+	while (read(jobs_pipe[0], buf, sizeof (buf)) > 0);
+
+	pthread_mutex_lock(&jobs_lock);
+	jobs = jobs_done;
+	jobs_done = NULL;
+	pthread_mutex_unlock(&jobs_lock);
+
+	/* Replies may point to session data the workers change */
+	mapiproxy_server_lock();
+	while ((job = jobs) != NULL) {
+		DLIST_REMOVE(jobs, job);
+		if (job->done) {
+			job->done(job->private_data);
+		}
+		talloc_free(job);
+	}
+	mapiproxy_server_unlock();
+}
+#endif
+
+
+/**
+   \details Start the worker threads of the current process, if enabled
+
+   \param lp_ctx pointer to the loadparm context
+   \param ev pointer to the event context replies are sent from
+
+   \note The decision is taken once the mapistore backends are loaded:
+   calls run on the event loop until then.
+
+   \return true if emsmdb calls are run by worker threads, otherwise
+   false
+ */
+_PUBLIC_ bool emsmdbp_threads_init(struct loadparm_context *lp_ctx, struct tevent_context *ev)
+{
+#if defined(HAVE_PTHREADS)
+	pthread_t	thread;
+	bool		thread_safe;
+	int		i;
+#endif
+	int		count;
+
+	if (emsmdbp_threads_initialized) {
+		return emsmdbp_threads_on;
+	}
+
+	count = lpcfg_parm_int(lp_ctx, NULL, "emsmdb", "worker_threads", 0);
+	if (count <= 0) {
+		emsmdbp_threads_initialized = true;
+		return false;
+	}
+
+#if defined(HAVE_PTHREADS)
+	if (mapistore_backend_thread_safe(&thread_safe) != MAPISTORE_SUCCESS) {
+		return false;
+	}
+	emsmdbp_threads_initialized = true;
+
+	if (thread_safe == false) {
+		OC_DEBUG(1, "emsmdb:worker_threads ignored: no mapistore backend is thread safe");
+		return false;
+	}
+
+	if (pipe(jobs_pipe) == -1) {
+		OC_DEBUG(0, "Unable to create the worker threads pipe: %s", strerror(errno));
+		return false;
+	}
+	fcntl(jobs_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(jobs_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(jobs_pipe[1], F_SETFD, FD_CLOEXEC);
+
+	jobs_ctx = talloc_named(NULL, 0, "emsmdbp_threads");
+	if (!jobs_ctx || !tevent_add_fd(ev, jobs_ctx, jobs_pipe[0], TEVENT_FD_READ,
+					emsmdbp_threads_done_handler, NULL)) {
+		OC_DEBUG(0, "Unable to watch the worker threads pipe");
+		goto fail;
+	}
+
+	mapiproxy_server_lock_enable();
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&thread, NULL, emsmdbp_thread_main, NULL) != 0) {
+			OC_DEBUG(0, "Unable to start emsmdb worker thread: %s", strerror(errno));
+			/* Threads already started just wait for jobs */
+			if (i == 0) goto fail;
+			break;
+		}
+		pthread_detach(thread);
+	}
+
+	mapistore_set_backend_call_hooks(mapiproxy_server_unlock, mapiproxy_server_lock);
+	threads_count = i;
+	emsmdbp_threads_on = true;
+	OC_DEBUG(3, "emsmdb calls run by %d worker threads", i);
+
+	return true;
+
+fail:
+	talloc_free(jobs_ctx);
+	jobs_ctx = NULL;
+	close(jobs_pipe[0]);
+	close(jobs_pipe[1]);
+	return false;
+#else
+	emsmdbp_threads_initialized = true;
+	OC_DEBUG(1, "emsmdb:worker_threads ignored: built without pthreads");
+	return false;
+#endif
+}
+
+
+/**
+   \details Take the server lock from the event loop before touching
+   data shared with the worker threads. Does nothing when worker
+   threads are disabled.
+ */
+_PUBLIC_ void emsmdbp_threads_lock(void)
+{
+	mapiproxy_server_lock();
+}
+
+
+/**
+   \details Release the server lock taken with emsmdbp_threads_lock
+ */
+_PUBLIC_ void emsmdbp_threads_unlock(void)
+{
+	mapiproxy_server_unlock();
+}
+
+
+/**
+   \details Return whether emsmdb calls are run by worker threads
+ */
+_PUBLIC_ bool emsmdbp_threads_enabled(void)
+{
+	return emsmdbp_threads_on;
+}
+
+
+/**
+   \details Queue a job for the worker threads. Jobs of the same
+   connection run one at a time, in the order they were queued.
+
+   \param server_id the server identifier of the connection
+   \param context_id the context identifier of the connection
+   \param work function run by a worker thread, holding the server lock
+   \param done function run from the event loop once work returned
+   \param private_data pointer passed to work and done
+
+   \return true on success, otherwise false
+ */
+_PUBLIC_ bool emsmdbp_threads_run(struct server_id server_id, uint32_t context_id,
+				  void (*work)(void *), void (*done)(void *), void *private_data)
+{
+#if defined(HAVE_PTHREADS)
+	struct emsmdbp_thread_job	*job;
+
+	if (!emsmdbp_threads_on || !work) return false;
+
+	job = talloc_zero(jobs_ctx, struct emsmdbp_thread_job);
+	if (!job) return false;
+	job->server_id = server_id;
+	job->context_id = context_id;
+	job->work = work;
+	job->done = done;
+	job->private_data = private_data;
+
+	pthread_mutex_lock(&jobs_lock);
+	job->bulk = (emsmdbp_thread_conn_find(&server_id, context_id) != NULL);
+	DLIST_ADD_END(jobs_pending, job, struct emsmdbp_thread_job *);
+	jobs_pending_count++;
+	mapiproxy_stats_add(MAPIPROXY_STATS_EMSMDB_JOBS, 1);
+	pthread_cond_signal(&jobs_cond);
+	pthread_mutex_unlock(&jobs_lock);
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+/**
+   \details Return the number of jobs waiting for a worker thread
+
+   \return the number of queued jobs, 0 when worker threads are
+   disabled
+ */
+_PUBLIC_ uint32_t emsmdbp_threads_queue_depth(void)
+{
+#if defined(HAVE_PTHREADS)
+	uint32_t	count;
+
+	if (!emsmdbp_threads_on) return 0;
+
+	pthread_mutex_lock(&jobs_lock);
+	count = jobs_pending_count;
+	pthread_mutex_unlock(&jobs_lock);
+
+	return count;
+#else
+	return 0;
+#endif
+}
+
+
+/**
+   \details Record that the call run by the current worker thread
+   processed bulk ROPs, so the next calls of its connection are picked
+   after the interactive ones
+ */
+_PUBLIC_ void emsmdbp_threads_set_bulk(void)
+{
+#if defined(HAVE_PTHREADS)
+	if (job_current) {
+		job_current->ran_bulk = true;
+	}
+#endif
+}
@@ -42,7 +42,7 @@
    \param mapi_repl pointer to the OpenFolder EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -105,12 +105,19 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenFolder(TALLOC_CTX *mem_ctx,
 		mapi_repl->error_code = retval;
 		goto end;
 	}
+
+	/* Folders of another mailbox must be visible to the user */
+	retval = emsmdbp_acl_check(emsmdbp_ctx, object, EMSMDBP_RIGHTS_FOLDER_VISIBLE);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_handles_delete(emsmdbp_ctx->handles_ctx, rec->handle);
+		mapi_repl->error_code = retval;
+		goto end;
+	}
+
 	retval = mapi_handles_set_private_data(rec, object);
 	handles[mapi_repl->handle_idx] = rec->handle;
 
 end:
-	*size += libmapiserver_RopOpenFolder_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -126,7 +133,7 @@ end:
    \param mapi_repl pointer to the GetHierarchyTable EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -212,8 +219,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetHierarchyTable(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopGetHierarchyTable_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -229,7 +234,7 @@ end:
    \param mapi_repl pointer to the GetContentsTable EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -243,6 +248,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetContentsTable(TALLOC_CTX *mem_ctx,
 	struct mapi_handles	*parent;
 	struct mapi_handles	*rec = NULL;
 	struct emsmdbp_object	*object = NULL, *parent_object;
+	struct emsmdbp_search_folder *search;
 	void			*data;
 	uint32_t		handle;
 	uint8_t			table_type;
@@ -314,6 +320,13 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetContentsTable(TALLOC_CTX *mem_ctx,
 		goto end;
 	}
 	mapi_handles_set_private_data(rec, object);
+
+	/* Search folder contents are the messages matching its criteria */
+	if (table_type == MAPISTORE_MESSAGE_TABLE && !emsmdbp_is_mapistore(parent_object) &&
+	    emsmdbp_search_get(emsmdbp_ctx, parent_object, &search) == MAPI_E_SUCCESS) {
+		object->object.table->search = search;
+		object->object.table->denominator = search->count;
+	}
 	mapi_repl->u.mapi_GetContentsTable.RowCount = object->object.table->denominator;
 
 	/* notifications */
@@ -323,8 +336,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetContentsTable(TALLOC_CTX *mem_ctx,
 
 end:
 	
-	*size += libmapiserver_RopGetContentsTable_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -339,7 +350,7 @@ end:
    \param mapi_repl pointer to the CreateFolder EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
 
@@ -462,7 +473,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateFolder(TALLOC_CTX *mem_ctx,
 			goto end;
 		}
 
-		retval = openchangedb_get_new_changeNumber(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, &cn);
+		retval = emsmdbp_change_number(emsmdbp_ctx, emsmdbp_ctx->username, &cn);
 		if (retval != MAPI_E_SUCCESS) {
 			OC_DEBUG(4, "exchange_emsmdb: [OXCFOLD] Could not obtain a new folder cn\n");
 			mapi_repl->error_code = MAPI_E_NO_SUPPORT;
@@ -496,8 +507,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateFolder(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopCreateFolder_size(mapi_repl);
-
 	if (aRow) {
 		talloc_free(aRow);
 	}
@@ -516,7 +525,7 @@ end:
    \param mapi_repl pointer to the DeleteFolder EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
 _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteFolder(TALLOC_CTX *mem_ctx,
@@ -581,8 +590,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteFolder(TALLOC_CTX *mem_ctx,
 	}
 	mapi_repl->error_code = retval;
 
-	*size += libmapiserver_RopDeleteFolder_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -598,7 +605,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteFolder(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the DeleteMessage EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -613,7 +620,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteMessages(TALLOC_CTX *mem_ctx,
 	void			*parent_folder_private_data;
 	struct emsmdbp_object	*parent_object;
 	char			*owner;
+	struct DeleteMessages_req	*request;
 	enum MAPISTATUS		retval;
+	enum mapistore_error	ret;
 	uint32_t		contextID;
 	int 			i;
 
@@ -652,31 +661,42 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteMessages(TALLOC_CTX *mem_ctx,
 
 	contextID = emsmdbp_get_contextID(parent_object);
 	owner = emsmdbp_get_owner(parent_object);
-	for (i = 0; i < mapi_req->u.mapi_DeleteMessages.cn_ids; ++i) {
-		int ret;
-		uint64_t mid = mapi_req->u.mapi_DeleteMessages.message_ids[i];
-		OC_DEBUG(0, "MID %i to delete: 0x%.16"PRIx64"\n", i, mid);
-		ret = mapistore_folder_delete_message(emsmdbp_ctx->mstore_ctx, contextID, parent_object->backend_object, mid, MAPISTORE_SOFT_DELETE);
-		if (ret != MAPISTORE_SUCCESS && ret != MAPISTORE_ERR_NOT_FOUND) {
-			if (ret == MAPISTORE_ERR_DENIED) {
-				mapi_repl->error_code = MAPI_E_NO_ACCESS;
-			}
-			else {
-				mapi_repl->error_code = MAPI_E_CALL_FAILED;
-			}
-			goto delete_message_response;
-		}
+	request = &mapi_req->u.mapi_DeleteMessages;
+	for (i = 0; i < request->cn_ids; ++i) {
+		OC_DEBUG(5, "MID %i to delete: 0x%.16"PRIx64"\n", i, request->message_ids[i]);
+	}
 
-		ret = mapistore_indexing_record_del_mid(emsmdbp_ctx->mstore_ctx, contextID, owner, mid, MAPISTORE_SOFT_DELETE);
-		if (ret != MAPISTORE_SUCCESS) {
+	/* Delete all the messages in one backend operation, then
+	 * update the indexes once for the whole set */
+	ret = mapistore_folder_delete_messages(emsmdbp_ctx->mstore_ctx, contextID, parent_object->backend_object,
+					       request->cn_ids, request->message_ids, MAPISTORE_SOFT_DELETE);
+	if (ret != MAPISTORE_SUCCESS) {
+		if (ret == MAPISTORE_ERR_DENIED) {
+			mapi_repl->error_code = MAPI_E_NO_ACCESS;
+		}
+		else {
 			mapi_repl->error_code = MAPI_E_CALL_FAILED;
-			goto delete_message_response;
 		}
+		goto delete_message_response;
 	}
 
-delete_message_response:
-	*size += libmapiserver_RopDeleteMessage_size(mapi_repl);
+	emsmdbp_freebusy_messages_deleted(emsmdbp_ctx, parent_object, request->cn_ids, request->message_ids);
+	for (i = 0; i < request->cn_ids; ++i) {
+		emsmdbp_search_message_removed(emsmdbp_ctx, parent_object->object.folder->folderID, request->message_ids[i]);
+	}
+	emsmdbp_content_index_messages_deleted(emsmdbp_ctx, parent_object, request->cn_ids, request->message_ids);
+	emsmdbp_tombstones_messages_deleted(emsmdbp_ctx, parent_object, request->cn_ids, request->message_ids);
+	emsmdbp_conversations_messages_deleted(emsmdbp_ctx, parent_object, request->cn_ids, request->message_ids);
+	emsmdbp_message_counts_folder_changed(emsmdbp_ctx, parent_object);
+
+	ret = mapistore_indexing_record_del_fmids(emsmdbp_ctx->mstore_ctx, contextID, owner,
+						  request->cn_ids, request->message_ids, MAPISTORE_SOFT_DELETE);
+	if (ret != MAPISTORE_SUCCESS) {
+		mapi_repl->error_code = MAPI_E_CALL_FAILED;
+		goto delete_message_response;
+	}
 
+delete_message_response:
 	return MAPI_E_SUCCESS;
 }
 
@@ -692,7 +712,7 @@ delete_message_response:
    \param mapi_repl pointer to the SetSearchCriteria EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error  
  */
@@ -702,6 +722,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetSearchCriteria(TALLOC_CTX *mem_ctx,
 						      struct EcDoRpc_MAPI_REPL *mapi_repl,
 						      uint32_t *handles, uint16_t *size)
 {
+	enum MAPISTATUS		retval;
+	struct mapi_handles	*rec = NULL;
+	struct emsmdbp_object	*object;
+	uint32_t		handle;
+	void			*data = NULL;
+
 	OC_DEBUG(4, "exchange_emsmdb: [OXCFOLD] SetSearchCriteria (0x30)\n");
 
 	/* Sanity checks */
@@ -715,10 +741,28 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetSearchCriteria(TALLOC_CTX *mem_ctx,
 	mapi_repl->handle_idx = mapi_req->handle_idx;
 	mapi_repl->error_code = MAPI_E_SUCCESS;
 
-	/* TODO: actually implement this */
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &rec);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
 
-	*size += libmapiserver_RopSetSearchCriteria_size(mapi_repl);
+	retval = mapi_handles_get_private_data(rec, &data);
+	object = (struct emsmdbp_object *)data;
+	if (retval || !object || object->type != EMSMDBP_OBJECT_FOLDER) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		goto end;
+	}
 
+	retval = emsmdbp_search_set_criteria(emsmdbp_ctx, object, &mapi_req->u.mapi_SetSearchCriteria);
+	if (retval) {
+		OC_DEBUG(5, "  unable to set search criteria: %s\n", mapi_get_errstr(retval));
+		mapi_repl->error_code = retval;
+	}
+
+end:
 	return MAPI_E_SUCCESS;
 }
 
@@ -734,7 +778,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetSearchCriteria(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the GetSearchCriteria EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -744,7 +788,16 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetSearchCriteria(TALLOC_CTX *mem_ctx,
 						      struct EcDoRpc_MAPI_REPL *mapi_repl,
 						      uint32_t *handles, uint16_t *size)
 {
-	/* struct mapi_SRestriction *res; */
+	struct GetSearchCriteria_req	*request;
+	struct GetSearchCriteria_repl	*response;
+	struct emsmdbp_search_folder	*search;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*rec = NULL;
+	struct emsmdbp_object		*object;
+	enum ndr_err_code		ndr_err_code;
+	DATA_BLOB			blob;
+	uint32_t			handle;
+	void				*data = NULL;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCFOLD] GetSearchCriteria (0x31)\n");
 
@@ -759,17 +812,52 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetSearchCriteria(TALLOC_CTX *mem_ctx,
 	mapi_repl->handle_idx = mapi_req->handle_idx;
 	mapi_repl->error_code = MAPI_E_SUCCESS;
 
-	/* res = NULL; */
-	mapi_repl->u.mapi_GetSearchCriteria.RestrictionDataSize = 0;
-	mapi_repl->u.mapi_GetSearchCriteria.LogonId = mapi_req->logon_id;
-	mapi_repl->u.mapi_GetSearchCriteria.FolderIdCount = 0;
-	mapi_repl->u.mapi_GetSearchCriteria.FolderIds = NULL;
-	mapi_repl->u.mapi_GetSearchCriteria.SearchFlags = 0;
+	request = &mapi_req->u.mapi_GetSearchCriteria;
+	response = &mapi_repl->u.mapi_GetSearchCriteria;
+	response->RestrictionDataSize = 0;
+	response->LogonId = mapi_req->logon_id;
+	response->FolderIdCount = 0;
+	response->FolderIds = NULL;
+	response->SearchFlags = 0;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &rec);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(rec, &data);
+	object = (struct emsmdbp_object *)data;
+	if (retval || !object || object->type != EMSMDBP_OBJECT_FOLDER) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		goto end;
+	}
 
-	/* TODO: actually implement this */
+	retval = emsmdbp_search_get(emsmdbp_ctx, object, &search);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		goto end;
+	}
 
-	*size += libmapiserver_RopGetSearchCriteria_size(mapi_repl);
+	/* The restriction is only marshalled when its size is set */
+	if (request->IncludeRestriction) {
+		ndr_err_code = ndr_push_struct_blob(&blob, mem_ctx, search->res, (ndr_push_flags_fn_t)ndr_push_mapi_SRestriction);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err_code) || blob.length > 0xffff) {
+			mapi_repl->error_code = MAPI_E_CALL_FAILED;
+			goto end;
+		}
+		response->RestrictionDataSize = blob.length;
+		response->RestrictionData = *search->res;
+	}
+	if (request->IncludeFolders) {
+		response->FolderIdCount = search->scope_count;
+		response->FolderIds = search->scope;
+	}
+	response->SearchFlags = emsmdbp_search_get_state(search);
 
+end:
 	return MAPI_E_SUCCESS;
 }
 
@@ -836,9 +924,9 @@ static enum MAPISTATUS RopEmptyFolder_GenericFolder(TALLOC_CTX *mem_ctx,
 		}
 
 		/* Update indexing entries */
-		retval = emsmdbp_folder_delete_indexing_records(emsmdbp_ctx->mstore_ctx, context_id,
-								owner, childFolders[i], deleted_fmids,
-								deleted_fmids_count, flags);
+		retval = emsmdbp_deferred_delete_indexing_records(emsmdbp_ctx, context_id,
+								  owner, childFolders[i], deleted_fmids,
+								  deleted_fmids_count, flags);
 		if (retval) {
 			OC_DEBUG(4, "exchange_emsmdb: [OXCFOLD] EmptyFolder failed to delete indexing entries for fid 0x%.16"PRIx64" (0x%x)", childFolders[i], retval);
 			ret = MAPI_E_NOT_FOUND;
@@ -863,7 +951,7 @@ end:
    \param mapi_repl pointer to the EmptyFolder EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -918,11 +1006,10 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopEmptyFolder(TALLOC_CTX *mem_ctx,
                                                       &mapi_repl->u.mapi_EmptyFolder,
                                                       folder);
 		mapi_repl->error_code = retval;
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, folder_object);
 		break;
 	}
 
-	*size += libmapiserver_RopEmptyFolder_size(mapi_repl);
-
 	/* reply filled in above */
 
 	return MAPI_E_SUCCESS;
@@ -939,14 +1026,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopMoveCopyMessages(TALLOC_CTX *mem_ctx,
 {
 	enum MAPISTATUS		retval;
 	uint32_t		handle;
-	uint32_t                contextID;
 	struct mapi_handles	*rec = NULL;
 	void			*private_data = NULL;
+	enum mapistore_error	ret;
 	struct emsmdbp_object	*destination_object;
 	struct emsmdbp_object   *source_object;
-	uint64_t                *targetMIDs;
-        uint32_t                i;
-	bool			mapistore = false;
+	bool			partial_completion = false;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCFOLD] RopMoveCopyMessages (0x33)\n");
 
@@ -999,30 +1084,21 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopMoveCopyMessages(TALLOC_CTX *mem_ctx,
 		goto end;
 	}
 
-	contextID = emsmdbp_get_contextID(destination_object);
-	mapistore = emsmdbp_is_mapistore(source_object);
-	if (mapistore) {
-		/* We prepare a set of new MIDs for the backend */
-		targetMIDs = talloc_array(NULL, uint64_t, mapi_req->u.mapi_MoveCopyMessages.count);
-		for (i = 0; i < mapi_req->u.mapi_MoveCopyMessages.count; i++) {
-			mapistore_indexing_get_new_folderID(emsmdbp_ctx->mstore_ctx, &targetMIDs[i]);
-		}
-
-		/* We invoke the backend method */
-		mapistore_folder_move_copy_messages(emsmdbp_ctx->mstore_ctx, contextID, destination_object->backend_object, source_object->backend_object, mem_ctx, mapi_req->u.mapi_MoveCopyMessages.count, mapi_req->u.mapi_MoveCopyMessages.message_id, targetMIDs, NULL, NULL, mapi_req->u.mapi_MoveCopyMessages.WantCopy);
-		talloc_free(targetMIDs);
-
-		/* /\* The backend might do this for us. In any case, we try to add it ourselves *\/ */
-		/* mapistore_indexing_record_add_mid(emsmdbp_ctx->mstore_ctx, contextID, targetMID); */
-	}
-	else {
+	ret = emsmdbp_folder_move_copy_messages(emsmdbp_ctx, source_object, destination_object, mem_ctx,
+						mapi_req->u.mapi_MoveCopyMessages.count,
+						mapi_req->u.mapi_MoveCopyMessages.message_id,
+						mapi_req->u.mapi_MoveCopyMessages.WantCopy,
+						&partial_completion);
+	if (ret == MAPISTORE_ERR_NOT_IMPLEMENTED) {
 		OC_DEBUG(0, "mapistore support not implemented yet - shouldn't occur\n");
 		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
 	}
+	else {
+		mapi_repl->error_code = mapistore_error_to_mapi(ret);
+		mapi_repl->u.mapi_MoveCopyMessages.PartialCompletion = partial_completion;
+	}
 
 end:
-	*size += libmapiserver_RopMoveCopyMessages_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1038,7 +1114,7 @@ end:
    \param mapi_repl pointer to the EmptyFolder EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1115,8 +1191,6 @@ enum MAPISTATUS EcDoRpc_RopMoveFolder(TALLOC_CTX *mem_ctx, struct emsmdbp_contex
 	response->PartialCompletion = false;
 
 end:
-	*size += libmapiserver_RopMoveFolder_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -1133,7 +1207,7 @@ end:
    \param mapi_repl pointer to the EmptyFolder EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1218,11 +1292,14 @@ enum MAPISTATUS EcDoRpc_RopCopyFolder(TALLOC_CTX *mem_ctx, struct emsmdbp_contex
 	contextID = emsmdbp_get_contextID(copy_folder);
 	ret = mapistore_folder_copy_folder(emsmdbp_ctx->mstore_ctx, contextID, copy_folder->backend_object, target_folder->backend_object, mem_ctx, request->WantRecursive, request->NewFolderName.lpszW);
 	mapi_repl->error_code = mapistore_error_to_mapi(ret);
+	if (ret == MAPISTORE_SUCCESS) {
+		emsmdbp_folder_update_recursive_counts(emsmdbp_ctx, target_folder, target_folder->object.folder->folderID,
+						       request->FolderId, 1, request->WantRecursive);
+		emsmdbp_folder_hierarchy_changed(emsmdbp_ctx, target_folder, target_folder->object.folder->folderID);
+	}
 	response->PartialCompletion = false;
 
 end:
-	*size += libmapiserver_RopCopyFolder_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -38,6 +38,8 @@
 /* the maximum buffer that will be populated during msg synchronization operations (note: this is a soft limit) */
 static const size_t max_message_sync_size = 262144;
 static const uint32_t message_preload_interval = 150;
+/* the same soft limit, applied to hierarchy synchronization operations */
+static const size_t max_hierarchy_sync_size = 262144;
 
 /** notes:
  * conventions:
@@ -77,7 +79,7 @@ struct oxcfxics_sync_data {
 	struct oxcfxics_prop_index	prop_index;
 
 	struct ndr_push			*ndr;
-	struct ndr_push			*cutmarks_ndr;
+	struct emsmdbp_stream_segments	*segments;
 
 	struct rawidset			*eid_set;
 	struct rawidset			*cnset_seen;
@@ -87,6 +89,10 @@ struct oxcfxics_sync_data {
 	struct rawidset			*deleted_eid_set;
 
 	struct oxcfxics_message_sync_data	*message_sync_data;
+	struct oxcfxics_folder_sync_cursor	*folder_cursor;
+
+	bool				hierarchy_cns;		/* hierarchy change numbers are stored */
+	uint64_t			hierarchy_cn_seen;	/* highest change number seen by the client, or 0 */
 };
 
 struct oxcfxics_message_sync_data {
@@ -94,6 +100,7 @@ struct oxcfxics_message_sync_data {
 	uint64_t	*cns;
 	uint64_t	count;
 	uint64_t	max;
+	uint64_t	preloaded;	/* mids before this index have been preloaded */
 };
 
 /** ndr helpers */
@@ -114,45 +121,6 @@ static void oxcfxics_ndr_check(struct ndr_push *ndr, const char *label)
 }
 #endif
 
-#if 1
-#define oxcfxics_check_cutmark_buffer(x,y)
-#else
-static void oxcfxics_check_cutmark_buffer(void *cutmark_buffer, DATA_BLOB *data_buffer)
-{
-	uint32_t *digits_ptr;
-	uint32_t min_size, prev_cutmark, cutmark;
-	bool done;
-
-	digits_ptr = cutmark_buffer;
-	prev_cutmark = 0;
-	done = false;
-	while (!done) {
-		cutmark = digits_ptr[1];
-		if (cutmark == 0xffffffff) {
-			done = true;
-		}
-		else {
-			min_size = digits_ptr[0];
-			if (min_size > 0) {
-				if (min_size != 4 && min_size != 8) {
-					OC_DEBUG(0, ("invalid min_size: %d\n", min_size));
-					abort();
-				}
-			}
-			if (cutmark < prev_cutmark && prev_cutmark > 0) {
-				OC_DEBUG(0, ("cutmark goes backward\n"));
-				abort();
-			}
-			if (cutmark > data_buffer->length) {
-				OC_DEBUG(0, ("cutmark goes beyond the buffer size\n"));
-				abort();
-			}
-			digits_ptr += 2;
-		}
-	}
-}
-#endif
-
 static const int message_properties_shift = 7;
 static const int folder_properties_shift = 7;
 
@@ -189,12 +157,9 @@ static void oxcfxics_ndr_push_simple_data(struct ndr_push *ndr, uint16_t prop_ty
 		ndr->flags = saved_flags;
 		break;
 	case PT_UNICODE:
-		saved_flags = ndr->flags;
-		string_len = strlen_m_ext((char *) value, CH_UTF8, CH_UTF16LE) * 2 + 2;
+		string_len = mapi_utf16_size((const char *) value);
 		ndr_push_uint32(ndr, NDR_SCALARS, string_len);
-		ndr_set_flags(&ndr->flags, LIBNDR_FLAG_STR_NULLTERM);
-		ndr_push_string(ndr, NDR_SCALARS, (char *) value);
-		ndr->flags = saved_flags;
+		libmapiserver_push_unicode(ndr, (const char *) value);
 		break;
 	case PT_SVREID:
 	case PT_BINARY:
@@ -220,12 +185,12 @@ static void oxcfxics_ndr_push_simple_data(struct ndr_push *ndr, uint16_t prop_ty
 	}
 }
 
-static uint32_t oxcfxics_compute_cutmark_min_value_buffer(uint16_t prop_type)
+static uint32_t oxcfxics_compute_min_value_buffer(uint16_t prop_type)
 {
 	uint32_t min_value_buffer;
 
 	if ((prop_type & MV_FLAG)) {
-		/* TODO: minimal cutmarks are difficult to deduce for multi values */
+		/* TODO: minimal sizes are difficult to deduce for multi values */
 		min_value_buffer = 8;
 	}
 	else {
@@ -257,7 +222,96 @@ static uint32_t oxcfxics_compute_cutmark_min_value_buffer(uint16_t prop_type)
 	return min_value_buffer;
 }
 
-static void oxcfxics_ndr_push_properties(struct ndr_push *ndr, struct ndr_push *cutmarks_ndr, void *nprops_ctx, struct SPropTagArray *properties, void **data_pointers, enum MAPISTATUS *retvals)
+/**
+   \details Allocate an empty segment index for a stream
+ */
+_PUBLIC_ struct emsmdbp_stream_segments *oxcfxics_stream_segments_init(TALLOC_CTX *mem_ctx)
+{
+	return talloc_zero(mem_ctx, struct emsmdbp_stream_segments);
+}
+
+/**
+   \details Record a place where a GetBuffer response may end, as the
+   stream is produced
+
+   \param segments the segment index of the stream
+   \param min_size 0 if the stream may only be cut at offset, otherwise
+   the value ending at offset may be split once that many bytes of it
+   are sent
+   \param offset the stream offset of the boundary
+ */
+_PUBLIC_ void oxcfxics_stream_segment_push(struct emsmdbp_stream_segments *segments, uint32_t min_size, uint32_t offset)
+{
+	struct emsmdbp_stream_segment	*entries;
+	uint32_t			alloc;
+
+	if (segments->count == segments->alloc) {
+		alloc = segments->alloc ? segments->alloc * 2 : 64;
+		entries = talloc_realloc(segments, segments->entries, struct emsmdbp_stream_segment, alloc);
+		if (!entries) {
+			/* the stream can still be cut at the boundaries already known */
+			OC_DEBUG(1, "Error allocating stream segments");
+			return;
+		}
+		segments->entries = entries;
+		segments->alloc = alloc;
+	}
+	segments->entries[segments->count].offset = offset;
+	segments->entries[segments->count].min_size = min_size;
+	segments->count++;
+}
+
+/**
+   \details Return the size of the next GetBuffer response, ending on
+   the last boundary before position + request_buffer_size
+
+   Boundaries are sorted by offset: the last one fitting is found with
+   a binary search among those following the previous response.
+
+   \param segments the segment index of the stream, may be NULL
+   \param position the current stream position
+   \param request_buffer_size the size requested by the client
+
+   \return the response size
+ */
+_PUBLIC_ uint32_t oxcfxics_stream_segments_slice(struct emsmdbp_stream_segments *segments, size_t position, uint32_t request_buffer_size)
+{
+	uint32_t	buffer_size, min_value_buffer;
+	uint32_t	low, high, middle;
+	size_t		max_offset;
+
+	buffer_size = request_buffer_size;
+	if (!segments) return buffer_size;
+
+	/* first boundary at or past the end of the requested buffer */
+	max_offset = position + request_buffer_size;
+	low = segments->next;
+	high = segments->count;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (segments->entries[middle].offset < max_offset) {
+			low = middle + 1;
+		}
+		else {
+			high = middle;
+		}
+	}
+
+	if (low > segments->next) {
+		buffer_size = segments->entries[low - 1].offset - position;
+	}
+	if (buffer_size < request_buffer_size && low < segments->count) {
+		min_value_buffer = segments->entries[low].min_size;
+		if (min_value_buffer && (request_buffer_size - buffer_size > min_value_buffer)) {
+			buffer_size = request_buffer_size;
+		}
+	}
+	segments->next = low;
+
+	return buffer_size;
+}
+
+static void oxcfxics_ndr_push_properties(struct ndr_push *ndr, struct emsmdbp_stream_segments *segments, void *nprops_ctx, struct SPropTagArray *properties, void **data_pointers, enum MAPISTATUS *retvals)
 {
 	uint32_t		i, j, min_value_buffer;
 	enum MAPITAGS		property;
@@ -300,8 +354,7 @@ static void oxcfxics_ndr_push_properties(struct ndr_push *ndr, struct ndr_push *
 				}
 				talloc_free(nameid);
 			}
-			ndr_push_uint32(cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(cutmarks_ndr, NDR_SCALARS, ndr->offset);
+			oxcfxics_stream_segment_push(segments, 0, ndr->offset);
 			if ((prop_type & MV_FLAG)) {
 				prop_type &= 0x0fff;
 
@@ -349,9 +402,8 @@ static void oxcfxics_ndr_push_properties(struct ndr_push *ndr, struct ndr_push *
 			else {
 				oxcfxics_ndr_push_simple_data(ndr, prop_type, data_pointers[i]);
 			}
-			min_value_buffer = oxcfxics_compute_cutmark_min_value_buffer(prop_type);
-			ndr_push_uint32(cutmarks_ndr, NDR_SCALARS, min_value_buffer);
-			ndr_push_uint32(cutmarks_ndr, NDR_SCALARS, ndr->offset);
+			min_value_buffer = oxcfxics_compute_min_value_buffer(prop_type);
+			oxcfxics_stream_segment_push(segments, min_value_buffer, ndr->offset);
 		}
         }
 
@@ -408,8 +460,7 @@ static struct Binary_r *oxcfxics_make_xid(TALLOC_CTX *mem_ctx, struct GUID *repl
 
 	data = talloc_zero(mem_ctx, struct Binary_r);
 	data->cb = ndr->offset;
-	data->lpb = ndr->data;
-	(void) talloc_reference(data, ndr->data);
+	data->lpb = talloc_steal(data, ndr->data);
 	talloc_free(ndr);
 
 	return data;
@@ -428,7 +479,7 @@ static inline struct Binary_r *oxcfxics_make_gid(TALLOC_CTX *mem_ctx, struct GUI
    \param mapi_req pointer to the EcDoRpc_RopFastTransferSourceCopyTo EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the EcDoRpc_RopFastTransferSourceCopyTo EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -447,7 +498,8 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFastTransferSourceCopyTo(TALLOC_CTX *mem_ctx
 	struct SPropTagArray			*needed_properties;
 	void					**data_pointers;
 	enum MAPISTATUS				*retvals;
-	struct ndr_push				*ndr, *cutmarks_ndr;
+	struct ndr_push				*ndr;
+	struct emsmdbp_stream_segments		*segments;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCFXICS] FastTransferSourceCopyTo (0x4d)\n");
 
@@ -500,11 +552,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFastTransferSourceCopyTo(TALLOC_CTX *mem_ctx
 			ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
 			ndr->offset = 0;
 
-			cutmarks_ndr = ndr_push_init_ctx(NULL);
-			ndr_set_flags(&cutmarks_ndr->flags, LIBNDR_FLAG_NOALIGN);
-			cutmarks_ndr->offset = 0;
+			segments = oxcfxics_stream_segments_init(ndr);
 
-			oxcfxics_ndr_push_properties(ndr, cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, needed_properties, data_pointers, retvals);
+			oxcfxics_ndr_push_properties(ndr, segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, needed_properties, data_pointers, retvals);
 
 			retval = mapi_handles_add(emsmdbp_ctx->handles_ctx, parent_handle_id, &object_handle);
 			object = emsmdbp_object_ftcontext_init(object_handle, emsmdbp_ctx, parent_object);
@@ -514,18 +564,11 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFastTransferSourceCopyTo(TALLOC_CTX *mem_ctx
 				goto end;
 			}
 
-			ndr_push_uint32(cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(cutmarks_ndr, NDR_SCALARS, 0xffffffff);
-
-			(void) talloc_reference(object, ndr->data);
-			(void) talloc_reference(object, cutmarks_ndr->data);
-
-			object->object.ftcontext->cutmarks = (uint32_t *) cutmarks_ndr->data;
-			object->object.ftcontext->stream.buffer.data = ndr->data;
+			object->object.ftcontext->segments = talloc_steal(object, segments);
+			object->object.ftcontext->stream.buffer.data = talloc_steal(object, ndr->data);
 			object->object.ftcontext->stream.buffer.length = ndr->offset;
 
 			talloc_free(ndr);
-			talloc_free(cutmarks_ndr);
 
 			mapi_handles_set_private_data(object_handle, object);
 			handles[mapi_repl->handle_idx] = object_handle->handle;
@@ -536,8 +579,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFastTransferSourceCopyTo(TALLOC_CTX *mem_ctx
 	}
 
 end:
-	*size += libmapiserver_RopFastTransferSourceCopyTo_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -551,10 +592,9 @@ static void oxcfxics_push_messageChange_recipients(struct emsmdbp_context *emsmd
 
 	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagFXDelProp);
 	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagMessageRecipients);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+	oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
-	min_string_value_buffer = oxcfxics_compute_cutmark_min_value_buffer(PT_UNICODE);
+	min_string_value_buffer = oxcfxics_compute_min_value_buffer(PT_UNICODE);
 
 	if (msg) {
 		local_mem_ctx = talloc_new(NULL);
@@ -574,34 +614,28 @@ static void oxcfxics_push_messageChange_recipients(struct emsmdbp_context *emsmd
 			recipient = msg->recipients + i;
 
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, StartRecip);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagRowid);
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, i);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 			if (email_idx != (uint32_t) -1 && recipient->data[email_idx]) {
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagAddressType);
 				oxcfxics_ndr_push_simple_data(sync_data->ndr, 0x1f, "SMTP");
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, min_string_value_buffer);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+				oxcfxics_stream_segment_push(sync_data->segments, min_string_value_buffer, sync_data->ndr->offset);
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagEmailAddress);
 				oxcfxics_ndr_push_simple_data(sync_data->ndr, 0x1f, recipient->data[email_idx]);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, min_string_value_buffer);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+				oxcfxics_stream_segment_push(sync_data->segments, min_string_value_buffer, sync_data->ndr->offset);
 			}
 			if (cn_idx != (uint32_t) -1 && recipient->data[cn_idx]) {
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagDisplayName);
 				oxcfxics_ndr_push_simple_data(sync_data->ndr, 0x1f, recipient->data[cn_idx]);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, min_string_value_buffer);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+				oxcfxics_stream_segment_push(sync_data->segments, min_string_value_buffer, sync_data->ndr->offset);
 			}
 
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagRecipientType);
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, recipient->type);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 			for (j = 0; j < msg->columns->cValues; j++) {
 				if (recipient->data[j] == NULL) {
@@ -612,10 +646,9 @@ static void oxcfxics_push_messageChange_recipients(struct emsmdbp_context *emsmd
 				}
 			}
 
-			oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, msg->columns, recipient->data, retvals);
+			oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, msg->columns, recipient->data, retvals);
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, EndToRecip);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 		}
 
 		talloc_free(local_mem_ctx);
@@ -641,8 +674,7 @@ static void oxcfxics_push_messageChange_attachment_embedded_message(struct emsmd
 	ret = mapistore_message_attachment_open_embedded_message(emsmdbp_ctx->mstore_ctx, contextID, attachment, mem_ctx, &embedded_message, &messageID, &msg);
 	if (ret == MAPISTORE_SUCCESS) {
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, StartEmbed);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 
 		properties = &synccontext->properties;
@@ -671,18 +703,15 @@ static void oxcfxics_push_messageChange_attachment_embedded_message(struct emsmd
 				retvals[i] = MAPI_E_NOT_FOUND;
 			}
 		}
-		oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, properties, data_pointers, retvals);
+		oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, properties, data_pointers, retvals);
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagFXDelProp);
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagMessageRecipients);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagFXDelProp);
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagMessageAttachments);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, EndEmbed);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 		RAWIDSET_push_guid_glob(sync_data->eid_set, &sync_data->replica_guid, (messageID >> 16) & 0x0000ffffffffffff);
 	}
@@ -724,15 +753,13 @@ static void oxcfxics_push_messageChange_attachments(struct emsmdbp_context *emsm
 			data_pointers = emsmdbp_object_table_get_row_props(mem_ctx, emsmdbp_ctx, table_object, i, MAPISTORE_PREFILTERED_QUERY, &retvals);
 			if (data_pointers) {
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, NewAttach);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+				oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, PidTagAttachNumber);
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, i);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+				oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 				query_props.cValues = prop_count;
 				query_props.aulPropTag = prop_tags;
-				oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, data_pointers, (enum MAPISTATUS *) retvals);
+				oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, data_pointers, (enum MAPISTATUS *) retvals);
 
 				if (retvals[0] == MAPI_E_SUCCESS) {
 					method = *((uint32_t *) data_pointers[0]);
@@ -743,8 +770,7 @@ static void oxcfxics_push_messageChange_attachments(struct emsmdbp_context *emsm
 				}
 
 				ndr_push_uint32(sync_data->ndr, NDR_SCALARS, EndAttach);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-				ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+				oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 			}
 			else {
 				OC_DEBUG(5, "no data returned for attachment row %d\n", i);
@@ -757,17 +783,16 @@ static void oxcfxics_push_messageChange_attachments(struct emsmdbp_context *emsm
 	talloc_free(table_object);
 }
 
-static void oxcfxics_table_set_cn_restriction(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *table_object, const char *owner, struct idset *cnset_seen)
+/**
+   \details Retrieve the highest change number the client has seen from
+   the local replica, when its change set is a single range
+
+   \return true if a change number was found, otherwise false
+ */
+static bool oxcfxics_cnset_get_high_watermark(struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct idset *cnset_seen, uint64_t *cnp)
 {
-	struct mapi_SRestriction cn_restriction;
 	struct idset *local_cnset;
 	uint16_t repl_id;
-	uint8_t state;
-
-	if (!emsmdbp_is_mapistore(table_object)) {
-		OC_DEBUG(5, "table restrictions not supported by non-mapistore tables\n");
-		return;
-	}
 
 	local_cnset = cnset_seen;
 	while (local_cnset && (emsmdbp_guid_to_replid(emsmdbp_ctx, owner, &local_cnset->repl.guid, &repl_id) != MAPI_E_SUCCESS || repl_id != 1)) {
@@ -775,11 +800,32 @@ static void oxcfxics_table_set_cn_restriction(struct emsmdbp_context *emsmdbp_ct
 	}
 
 	if (!local_cnset) {
-		OC_DEBUG(5, "no change set available -> no table restrictions\n");
-		return;
+		OC_DEBUG(5, "no change set available\n");
+		return false;
 	}
 	if (local_cnset->range_count != 1) {
-		OC_DEBUG(5, "no valid change set available (range_count = %d) -> no table restrictions\n", local_cnset->range_count);
+		OC_DEBUG(5, "no valid change set available (range_count = %d)\n", local_cnset->range_count);
+		return false;
+	}
+
+	*cnp = (local_cnset->ranges[0].high << 16) | repl_id;
+
+	return true;
+}
+
+static void oxcfxics_table_set_cn_restriction(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *table_object, const char *owner, struct idset *cnset_seen)
+{
+	struct mapi_SRestriction cn_restriction;
+	uint64_t cn;
+	uint8_t state;
+
+	if (!emsmdbp_is_mapistore(table_object)) {
+		OC_DEBUG(5, "table restrictions not supported by non-mapistore tables\n");
+		return;
+	}
+
+	if (!oxcfxics_cnset_get_high_watermark(emsmdbp_ctx, owner, cnset_seen, &cn)) {
+		OC_DEBUG(5, "no table restrictions\n");
 		return;
 	}
 
@@ -787,11 +833,112 @@ static void oxcfxics_table_set_cn_restriction(struct emsmdbp_context *emsmdbp_ct
 	cn_restriction.res.resProperty.relop = RELOP_GT;
 	cn_restriction.res.resProperty.ulPropTag = PidTagChangeNumber;
 	cn_restriction.res.resProperty.lpProp.ulPropTag = PidTagChangeNumber;
-	cn_restriction.res.resProperty.lpProp.value.d = (cnset_seen->ranges[0].high << 16) | repl_id;
+	cn_restriction.res.resProperty.lpProp.value.d = cn;
 
 	mapistore_table_set_restrictions(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(table_object), table_object->backend_object, &cn_restriction, &state);
 }
 
+/**
+   \details Ask the backend for the messages changed since the highest
+   change number the client has seen, instead of walking the folder
+   table. Backends answer from an index ordered by change number.
+
+   Messages are returned by ascending change number, or most recent
+   change first when the client asked for delivery time order.
+
+   \return true if message_sync_data was filled, false if the backend
+   can not answer or the client has no usable change set
+ */
+static bool oxcfxics_message_sync_load_changed(struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct emsmdbp_object *folder_object,
+					       enum mapistore_table_type table_type, bool most_recent_first,
+					       struct idset *cnset_seen, struct oxcfxics_message_sync_data *message_sync_data)
+{
+	struct UI8Array_r	*fmids = NULL;
+	enum mapistore_error	ret;
+	uint64_t		cn;
+	uint32_t		i;
+
+	if (!emsmdbp_is_mapistore(folder_object)) return false;
+	if (!oxcfxics_cnset_get_high_watermark(emsmdbp_ctx, owner, cnset_seen, &cn)) return false;
+
+	ret = mapistore_folder_get_changed_fmids(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(folder_object),
+						 folder_object->backend_object, message_sync_data, table_type, cn, &fmids);
+	if (ret != MAPISTORE_SUCCESS || !fmids) {
+		if (ret != MAPISTORE_ERR_NOT_IMPLEMENTED) {
+			OC_DEBUG(5, "unable to get changed messages from the backend: %s\n", mapistore_errstr(ret));
+		}
+		return false;
+	}
+
+	/* Change numbers are read with the messages */
+	message_sync_data->mids = talloc_array(message_sync_data, uint64_t, fmids->cValues + 1);
+	message_sync_data->cns = talloc_zero_array(message_sync_data, uint64_t, fmids->cValues + 1);
+	if (!message_sync_data->mids || !message_sync_data->cns) {
+		OC_DEBUG(1, "Error allocating mid array");
+		talloc_free(fmids);
+		return false;
+	}
+	for (i = 0; i < fmids->cValues; i++) {
+		message_sync_data->mids[i] = fmids->lpui8[most_recent_first ? fmids->cValues - 1 - i : i];
+	}
+	message_sync_data->max = fmids->cValues;
+	talloc_free(fmids);
+
+	return true;
+}
+
+/**
+   \details Tell whether the message at the given index of the sync
+   table is already known by the client
+ */
+static inline bool oxcfxics_message_sync_is_seen(struct oxcfxics_sync_data *sync_data, struct oxcfxics_message_sync_data *message_sync_data, struct idset *original_cnset_seen, uint64_t idx)
+{
+	uint64_t	cn;
+
+	if (message_sync_data->cns[idx] == 0) {
+		return false;
+	}
+	cn = ((message_sync_data->cns[idx] >> 16) & 0x0000ffffffffffff);
+
+	return IDSET_includes_guid_glob(original_cnset_seen, &sync_data->replica_guid, cn);
+}
+
+/**
+   \details Ask the backend to preload the bodies of the next messages
+   to send, so it can fetch them in a single batch instead of one
+   request per message. Messages the client already has are left out
+   of the window.
+ */
+static void oxcfxics_message_sync_preload(struct emsmdbp_context *emsmdbp_ctx, uint32_t contextID, struct emsmdbp_object *folder_object, enum mapistore_table_type mstore_type, struct oxcfxics_sync_data *sync_data, struct oxcfxics_message_sync_data *message_sync_data, struct idset *original_cnset_seen)
+{
+	struct UI8Array_r	preload_mids;
+	uint64_t		idx, eid;
+
+	if (message_sync_data->count < message_sync_data->preloaded) {
+		return;
+	}
+
+	preload_mids.cValues = 0;
+	preload_mids.lpui8 = talloc_array(NULL, uint64_t, message_preload_interval);
+	if (!preload_mids.lpui8) {
+		return;
+	}
+
+	for (idx = message_sync_data->count; idx < message_sync_data->max && preload_mids.cValues < message_preload_interval; idx++) {
+		eid = message_sync_data->mids[idx];
+		if (eid == 0x7fffffffffffffffLL) continue;
+		if (oxcfxics_message_sync_is_seen(sync_data, message_sync_data, original_cnset_seen, idx)) continue;
+		preload_mids.lpui8[preload_mids.cValues] = eid;
+		preload_mids.cValues++;
+	}
+	message_sync_data->preloaded = idx;
+
+	if (preload_mids.cValues) {
+		mapistore_folder_preload_message_bodies(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object, mstore_type, &preload_mids);
+	}
+	talloc_free(preload_mids.lpui8);
+}
+
 static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object_synccontext *synccontext, const char *owner, struct oxcfxics_sync_data *sync_data, struct emsmdbp_object *folder_object)
 {
 	TALLOC_CTX			*mem_ctx, *msg_ctx;
@@ -818,9 +965,13 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 	struct UI8Array_r		*deleted_eids;
 	struct SPropTagArray		*msg_properties, *properties, *sharing_properties;
 	struct oxcfxics_message_sync_data	*message_sync_data;
+	struct emsmdbp_table_row_props	*rows;
+	uint32_t			batch, fetched, j;
 	struct SSortOrderSet		lpSortCriteria;
 	uint8_t				status;
 	struct oxcfxics_prop_index	msg_prop_index;
+	enum mapistore_error		ret;
+	uint32_t			chunk_start;
 
 	mem_ctx = talloc_zero(NULL, void);
 
@@ -841,74 +992,96 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 		message_sync_data = sync_data->message_sync_data;
 	}
 	else {
-		message_sync_data = talloc_zero(NULL, struct oxcfxics_message_sync_data);
+		message_sync_data = talloc_zero(sync_data, struct oxcfxics_message_sync_data);
 		sync_data->message_sync_data = message_sync_data;
 
 		/* we only push "messageChangeFull" since we don't handle property-based changes */
 		/* messageChangeFull = IncrSyncChg messageChangeHeader IncrSyncMessage propList messageChildren */
 
-		table_object = emsmdbp_folder_open_table(mem_ctx, folder_object, sync_data->table_type, 0);
-		if (!table_object) {
-			OC_DEBUG(5, "could not open folder table\n");
-			abort();
+		if (oxcfxics_message_sync_load_changed(emsmdbp_ctx, owner, folder_object, sync_data->table_type,
+							 synccontext->request.order_by_delivery_time,
+							 original_cnset_seen, message_sync_data)) {
+			synccontext->total_objects += message_sync_data->max;
+			OC_DEBUG(5, "push_messageChange: %"PRId64" changed objects from the backend\n", message_sync_data->max);
 		}
-
-		table_object->object.table->prop_count = table_props_count;
-		table_object->object.table->properties = (enum MAPITAGS *)table_prop_tags;
-
-		oxcfxics_table_set_cn_restriction(emsmdbp_ctx, table_object, owner, original_cnset_seen);
-		message_sync_data->max = 0;
-		if (emsmdbp_is_mapistore(table_object)) {
-			contextID = emsmdbp_get_contextID(folder_object);
-			mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object,
-						    table_object->object.table->prop_count, table_object->object.table->properties);
-			if (synccontext->request.order_by_delivery_time) {
-				/* sort messages: most recent delivery time first when available.
-				   [MS-OXCFXICS] Section 3.2.5.9.1.1 */
-				lpSortCriteria.cSorts = 1;
-				lpSortCriteria.cCategories = 0;
-				lpSortCriteria.cExpanded = 0;
-				lpSortCriteria.aSort = talloc_array(mem_ctx, struct SSortOrder, 1);
-				lpSortCriteria.aSort[0].ulPropTag = PidTagMessageDeliveryTime;
-				lpSortCriteria.aSort[0].ulOrder = TABLE_SORT_DESCEND;
-				mapistore_table_set_sort_order(emsmdbp_ctx->mstore_ctx, contextID,
-							       table_object->backend_object,
-							       &lpSortCriteria, &status);
-				talloc_free(lpSortCriteria.aSort);
+		else {
+			table_object = emsmdbp_folder_open_table(mem_ctx, folder_object, sync_data->table_type, 0);
+			if (!table_object) {
+				OC_DEBUG(5, "could not open folder table\n");
+				abort();
 			}
 
-			mapistore_table_get_row_count(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object, MAPISTORE_PREFILTERED_QUERY, &table_object->object.table->denominator);
-			synccontext->total_objects += table_object->object.table->denominator;
+			table_object->object.table->prop_count = table_props_count;
+			table_object->object.table->properties = (enum MAPITAGS *)table_prop_tags;
+
+			oxcfxics_table_set_cn_restriction(emsmdbp_ctx, table_object, owner, original_cnset_seen);
+			message_sync_data->max = 0;
+			if (emsmdbp_is_mapistore(table_object)) {
+				contextID = emsmdbp_get_contextID(folder_object);
+				mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object,
+							    table_object->object.table->prop_count, table_object->object.table->properties);
+				if (synccontext->request.order_by_delivery_time) {
+					/* sort messages: most recent delivery time first when available.
+					   [MS-OXCFXICS] Section 3.2.5.9.1.1 */
+					lpSortCriteria.cSorts = 1;
+					lpSortCriteria.cCategories = 0;
+					lpSortCriteria.cExpanded = 0;
+					lpSortCriteria.aSort = talloc_array(mem_ctx, struct SSortOrder, 1);
+					lpSortCriteria.aSort[0].ulPropTag = PidTagMessageDeliveryTime;
+					lpSortCriteria.aSort[0].ulOrder = TABLE_SORT_DESCEND;
+					mapistore_table_set_sort_order(emsmdbp_ctx->mstore_ctx, contextID,
+								       table_object->backend_object,
+								       &lpSortCriteria, &status);
+					talloc_free(lpSortCriteria.aSort);
+				}
 
-			OC_DEBUG(5, "push_messageChange: %d objects in table\n", table_object->object.table->denominator);
+				mapistore_table_get_row_count(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object, MAPISTORE_PREFILTERED_QUERY, &table_object->object.table->denominator);
+				synccontext->total_objects += table_object->object.table->denominator;
 
-			/* fetch maching mids */
-			message_sync_data->mids = talloc_zero_array(message_sync_data, uint64_t, table_object->object.table->denominator);
-			if (!message_sync_data->mids) {
-				OC_DEBUG(1, "Error allocating mid array");
-				goto end;
-			}
-			message_sync_data->cns = talloc_zero_array(message_sync_data, uint64_t,
-								   table_object->object.table->denominator);
-			if (!message_sync_data->cns) {
-				OC_DEBUG(1, "Error allocating change number array");
-				goto end;
-			}
+				OC_DEBUG(5, "push_messageChange: %d objects in table\n", table_object->object.table->denominator);
 
-			for (i = 0; i < table_object->object.table->denominator; i++) {
-				data_pointers = emsmdbp_object_table_get_row_props(mem_ctx, emsmdbp_ctx, table_object, i, MAPISTORE_PREFILTERED_QUERY, &retvals);
-				if (data_pointers) {
-					if (retvals[0] == MAPI_E_SUCCESS) {
-						message_sync_data->mids[message_sync_data->max] = *(uint64_t *) data_pointers[0];
-						if (retvals[1] == MAPI_E_SUCCESS) {
-							message_sync_data->cns[message_sync_data->max] = *(uint64_t *) data_pointers[1];
-						} else {
-							OC_DEBUG(5, "Unable to get change number for mid: %" PRIx64,
-								 *(uint64_t *) data_pointers[0]);
-							message_sync_data->cns[message_sync_data->max] = 0;
+				/* fetch maching mids */
+				message_sync_data->mids = talloc_zero_array(message_sync_data, uint64_t, table_object->object.table->denominator);
+				if (!message_sync_data->mids) {
+					OC_DEBUG(1, "Error allocating mid array");
+					goto end;
+				}
+				message_sync_data->cns = talloc_zero_array(message_sync_data, uint64_t,
+									   table_object->object.table->denominator);
+				if (!message_sync_data->cns) {
+					OC_DEBUG(1, "Error allocating change number array");
+					goto end;
+				}
+
+				for (i = 0; i < table_object->object.table->denominator; i += batch) {
+					batch = table_object->object.table->denominator - i;
+					if (batch > EMSMDBP_TABLE_ROW_CACHE_SIZE) {
+						batch = EMSMDBP_TABLE_ROW_CACHE_SIZE;
+					}
+					rows = emsmdbp_object_table_get_rows_props(mem_ctx, emsmdbp_ctx, table_object, i, batch,
+										   MAPISTORE_PREFILTERED_QUERY, &fetched);
+					if (!rows) {
+						/* skip the unreadable row, as the single-row walk did */
+						batch = 1;
+						continue;
+					}
+					for (j = 0; j < fetched; j++) {
+						data_pointers = rows[j].data_pointers;
+						retvals = rows[j].retvals;
+						if (retvals[0] == MAPI_E_SUCCESS) {
+							message_sync_data->mids[message_sync_data->max] = *(uint64_t *) data_pointers[0];
+							if (retvals[1] == MAPI_E_SUCCESS) {
+								message_sync_data->cns[message_sync_data->max] = *(uint64_t *) data_pointers[1];
+							} else {
+								OC_DEBUG(5, "Unable to get change number for mid: %" PRIx64,
+									 *(uint64_t *) data_pointers[0]);
+								message_sync_data->cns[message_sync_data->max] = 0;
+							}
+							message_sync_data->max++;
 						}
-						message_sync_data->max++;
 					}
+					talloc_free(rows);
+					batch = fetched;
 				}
 			}
 		}
@@ -926,8 +1099,11 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 		retval_msg_class = SPropTagArray_find(*properties, PidTagMessageClass, &message_class_prop_index);
 	}
 
-	/* open each message and fetch properties */
-	for (; sync_data->ndr->offset < max_message_sync_size && message_sync_data->count < message_sync_data->max; message_sync_data->count++) {
+	/* open each message and fetch properties, until the chunk is full
+	   or, once it holds a message, the call spent its time slice */
+	chunk_start = sync_data->ndr->offset;
+	for (; sync_data->ndr->offset < max_message_sync_size && message_sync_data->count < message_sync_data->max &&
+		     (sync_data->ndr->offset == chunk_start || !emsmdbp_sched_yield(emsmdbp_ctx)); message_sync_data->count++) {
 		msg_ctx = talloc_new(NULL);
 		msg_properties = properties;
 
@@ -941,24 +1117,15 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 		emsmdbp_replid_to_guid(emsmdbp_ctx, owner, eid & 0xffff, &replica_guid);
 		RAWIDSET_push_guid_glob(sync_data->eid_set, &replica_guid, (eid >> 16) & 0x0000ffffffffffff);
 
-		if (folder_is_mapistore && message_sync_data->cns[message_sync_data->count] != 0) {
-			cn = ((message_sync_data->cns[message_sync_data->count] >> 16) & 0x0000ffffffffffff);
-			if (IDSET_includes_guid_glob(original_cnset_seen, &sync_data->replica_guid, cn)) {
-				synccontext->skipped_objects++;
-				OC_DEBUG(5, "Skip message %"PRIx64" as cn %.12"PRIx64" already present\n", eid, cn);
-				goto end_row;
-			}
+		if (folder_is_mapistore && oxcfxics_message_sync_is_seen(sync_data, message_sync_data, original_cnset_seen, message_sync_data->count)) {
+			synccontext->skipped_objects++;
+			OC_DEBUG(5, "Skip message %"PRIx64" as cn %.12"PRIx64" already present\n", eid,
+				 (message_sync_data->cns[message_sync_data->count] >> 16) & 0x0000ffffffffffff);
+			goto end_row;
 		}
 
-		if (folder_is_mapistore && (message_sync_data->count % message_preload_interval) == 0) {
-			preload_mids.lpui8 = message_sync_data->mids + message_sync_data->count;
-			if ((message_sync_data->count + message_preload_interval) < message_sync_data->max) {
-				preload_mids.cValues = message_preload_interval;
-			}
-			else {
-				preload_mids.cValues = message_sync_data->max - message_sync_data->count;
-			}
-			mapistore_folder_preload_message_bodies(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object, mstore_type, &preload_mids);
+		if (folder_is_mapistore) {
+			oxcfxics_message_sync_preload(emsmdbp_ctx, contextID, folder_object, mstore_type, sync_data, message_sync_data, original_cnset_seen);
 		}
 
 		if (emsmdbp_object_message_open(msg_ctx, emsmdbp_ctx, folder_object, folder_object->object.folder->folderID, eid, false, &message_object, &msg) != MAPISTORE_SUCCESS) {
@@ -1001,7 +1168,6 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 
 
 		oxcfxics_ndr_check(sync_data->ndr, "sync_data->ndr");
-		oxcfxics_ndr_check(sync_data->cutmarks_ndr, "sync_data->cutmarks_ndr");
 
 		/** fixed header props */
 		header_data_pointers = talloc_array(data_pointers, void *, 9);
@@ -1128,20 +1294,18 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 		query_props.cValues = i;
 
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncChg);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
-		oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, header_data_pointers, (enum MAPISTATUS *) header_retvals);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
+		oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, header_data_pointers, (enum MAPISTATUS *) header_retvals);
 
 		/** remaining props */
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncMessage);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 		/* we shift the number of remaining properties to the amount of properties explicitly requested in RopSyncConfigure that were used above */
 		if (msg_properties->cValues > message_properties_shift) {
 			query_props.cValues = msg_properties->cValues - message_properties_shift;
 			query_props.aulPropTag = msg_properties->aulPropTag + message_properties_shift;
-			oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, data_pointers + message_properties_shift, (enum MAPISTATUS *) retvals + message_properties_shift);
+			oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, data_pointers + message_properties_shift, (enum MAPISTATUS *) retvals + message_properties_shift);
 		}
 
 		/* messageChildren:
@@ -1178,7 +1342,17 @@ static bool oxcfxics_push_messageChange(struct emsmdbp_context *emsmdbp_ctx, str
 			else {
 				cn = 0;
 			}
-			if (!mapistore_folder_get_deleted_fmids(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object, mem_ctx, sync_data->table_type, cn, &deleted_eids, &cn)) {
+			/* read the deleted messages log first, the backend
+			   answers when it does not go back far enough */
+			ret = MAPISTORE_ERR_NOT_FOUND;
+			if (sync_data->table_type == MAPISTORE_MESSAGE_TABLE) {
+				ret = mapistore_tombstones_get(mem_ctx, emsmdbp_ctx->mstore_ctx, owner, folder_object->object.folder->folderID,
+							       cn, &deleted_eids, &cn);
+			}
+			if (ret == MAPISTORE_ERR_NOT_FOUND) {
+				ret = mapistore_folder_get_deleted_fmids(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object, mem_ctx, sync_data->table_type, cn, &deleted_eids, &cn);
+			}
+			if (ret == MAPISTORE_SUCCESS) {
 				for (i = 0; i < deleted_eids->cValues; i++) {
                                         if (IDSET_includes_guid_glob(synccontext->idset_given, &sync_data->replica_guid, (deleted_eids->lpui8[i] >> 16) & 0x0000ffffffffffff)) {
                                                 RAWIDSET_push_guid_glob(sync_data->deleted_eid_set, &sync_data->replica_guid, (deleted_eids->lpui8[i] >> 16) & 0x0000ffffffffffff);
@@ -1216,7 +1390,7 @@ static void oxcfxics_fill_synccontext_with_messageChange(struct emsmdbp_object_s
 
 	if (synccontext->sync_stage == 0) {
 		/* 1. we setup the mandatory properties indexes */
-		sync_data = talloc_zero(NULL, struct oxcfxics_sync_data);
+		sync_data = talloc_zero(synccontext, struct oxcfxics_sync_data);
 		openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, owner, NULL, &sync_data->replica_guid);
 		SPropTagArray_find(synccontext->properties, PidTagMid, &sync_data->prop_index.eid);
 		SPropTagArray_find(synccontext->properties, PidTagChangeNumber, &sync_data->prop_index.change_number);
@@ -1236,14 +1410,12 @@ static void oxcfxics_fill_synccontext_with_messageChange(struct emsmdbp_object_s
 	else {
 		sync_data = synccontext->sync_data;
 		talloc_free(sync_data->ndr);
-		talloc_free(sync_data->cutmarks_ndr);
+		talloc_free(sync_data->segments);
 	}
 	sync_data->ndr = ndr_push_init_ctx(sync_data);
 	ndr_set_flags(&sync_data->ndr->flags, LIBNDR_FLAG_NOALIGN);
 	sync_data->ndr->offset = 0;
-	sync_data->cutmarks_ndr = ndr_push_init_ctx(sync_data);
-	ndr_set_flags(&sync_data->cutmarks_ndr->flags, LIBNDR_FLAG_NOALIGN);
-	sync_data->cutmarks_ndr->offset = 0;
+	sync_data->segments = oxcfxics_stream_segments_init(sync_data);
 
 	if (synccontext->sync_stage == 1) {
 		/* 2a. we build the message stream (normal messages) */
@@ -1304,22 +1476,18 @@ static void oxcfxics_fill_synccontext_with_messageChange(struct emsmdbp_object_s
 			new_idset->idbased = true;
 			new_idset->repl.id = 1;
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncDel);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagIdsetDeleted);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 			ndr_push_idset(sync_data->ndr, new_idset);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 			/* IDSET_dump (new_idset, "cnset_deleted"); */
 			talloc_free(new_idset);
 		}
 
 		/* state */
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncStateBegin);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 		new_idset = RAWIDSET_convert_to_idset(NULL, sync_data->eid_set);
 		old_idset = synccontext->idset_given;
@@ -1331,20 +1499,16 @@ static void oxcfxics_fill_synccontext_with_messageChange(struct emsmdbp_object_s
 
 		IDSET_dump (synccontext->cnset_seen, "cnset_seen");
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagCnsetSeen);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 		ndr_push_idset(sync_data->ndr, synccontext->cnset_seen);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 		if (synccontext->request.fai) {
 			IDSET_dump (synccontext->cnset_seen_fai, "cnset_seen_fai");
 			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagCnsetSeenFAI);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 			ndr_push_idset(sync_data->ndr, synccontext->cnset_seen_fai);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+			oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 		}
 		IDSET_dump (synccontext->idset_given, "idset_given");
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagIdsetGiven);
@@ -1355,357 +1519,570 @@ static void oxcfxics_fill_synccontext_with_messageChange(struct emsmdbp_object_s
 			ndr_push_idset(sync_data->ndr, synccontext->cnset_read);
 		}
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncStateEnd);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 		/* end of stream */
 		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncEnd);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-		ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
 		synccontext->sync_stage = 4;
 	}
 
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0xffffffff);
-
-	synccontext->cutmarks = (uint32_t *) sync_data->cutmarks_ndr->data;
-	synccontext->next_cutmark_idx = 1;
+	synccontext->segments = sync_data->segments;
 	synccontext->stream.position = 0;
 	synccontext->stream.buffer.data = sync_data->ndr->data;
 	synccontext->stream.buffer.length = sync_data->ndr->offset;
 
 	if (synccontext->sync_stage == 4) {
-		(void) talloc_reference(synccontext, sync_data->ndr->data);
-		(void) talloc_reference(synccontext, sync_data->cutmarks_ndr->data);
+		(void) talloc_steal(synccontext, sync_data->ndr->data);
+		(void) talloc_steal(synccontext, sync_data->segments);
 		talloc_free(sync_data);
 		synccontext->sync_data = NULL;
 	}
 }
 
-static void oxcfxics_push_folderChange(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object_synccontext *synccontext, const char *owner, struct emsmdbp_object *topmost_folder_object, struct oxcfxics_sync_data *sync_data, struct emsmdbp_object *folder_object)
+/* A folder of the hierarchy being walked, resumed on every chunk */
+struct oxcfxics_folder_sync_cursor {
+	struct emsmdbp_object			*folder_object;
+	struct emsmdbp_object			*table_object;
+	uint32_t				next_row;
+	struct oxcfxics_folder_sync_cursor	*parent;
+	uint64_t				hierarchy_cn;		/* highest change number found in the subtree */
+	bool					store_hierarchy_cn;	/* no hierarchy change number is stored for the folder */
+	bool					partial;		/* part of the subtree could not be walked */
+};
+
+static inline uint64_t oxcfxics_folder_object_fid(struct emsmdbp_object *folder_object)
+{
+	return (folder_object->type == EMSMDBP_OBJECT_MAILBOX) ? folder_object->object.mailbox->folderID
+							       : folder_object->object.folder->folderID;
+}
+
+/**
+   \details Tell whether the hierarchy under a folder is unchanged since
+   the change set seen by the client, from the hierarchy change number
+   stored in openchangedb
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param owner the owner of the mailbox
+   \param sync_data the hierarchy synchronization data
+   \param fid the folder identifier
+   \param cnp pointer to the returned hierarchy change number, 0 when
+   none is stored
+
+   \return true if the folder's subtree can be skipped entirely
+ */
+static bool oxcfxics_folder_hierarchy_is_seen(struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct oxcfxics_sync_data *sync_data, uint64_t fid, uint64_t *cnp)
+{
+	*cnp = 0;
+	if (!sync_data->hierarchy_cns) return false;
+	if (openchangedb_get_hierarchy_change_number(emsmdbp_ctx->oc_ctx, owner, fid, cnp) != MAPI_E_SUCCESS) {
+		*cnp = 0;
+		return false;
+	}
+
+	return (sync_data->hierarchy_cn_seen && *cnp <= sync_data->hierarchy_cn_seen);
+}
+
+/**
+   \details Push the folderChange of a hierarchy table row
+
+   \return the folder id of the row, 0 if the row was skipped entirely
+ */
+static uint64_t oxcfxics_push_folderChange_row(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object_synccontext *synccontext, const char *owner, struct emsmdbp_object *topmost_folder_object, struct oxcfxics_sync_data *sync_data, struct emsmdbp_object *folder_object, struct emsmdbp_object *table_object, void **data_pointers, enum MAPISTATUS *retvals)
 {
-	TALLOC_CTX		*mem_ctx;
-	struct emsmdbp_object	*table_object, *subfolder_object;
 	uint64_t		eid, cn;
 	struct Binary_r		predecessors_data;
 	struct Binary_r		*bin_data;
 	struct FILETIME		*lm_time;
 	NTTIME			nt_time;
-	int32_t			unix_time, contextID;
-	uint32_t		i, j;
-	enum MAPISTATUS		*retvals, *header_retvals;
-	enum mapistore_error	retval;
-	void			**data_pointers, **header_data_pointers;
+	int32_t			unix_time;
+	uint32_t		j;
+	enum MAPISTATUS		*header_retvals;
+	void			**header_data_pointers;
 	struct SPropTagArray	query_props;
 	struct GUID		replica_guid;
 
-	mem_ctx = talloc_zero(NULL, void);
+	/** fixed header props */
+	header_data_pointers = talloc_array(NULL, void *, 8);
+	header_retvals = talloc_array(header_data_pointers, enum MAPISTATUS, 8);
+	memset(header_retvals, 0, 8 * sizeof(uint32_t));
+	query_props.aulPropTag = talloc_array(header_data_pointers, enum MAPITAGS, 8);
+
+	j = 0;
+
+	/* parent source key */
+	if (folder_object == topmost_folder_object) {
+		/* No parent source key at the first hierarchy level */
+		bin_data = talloc_zero(header_data_pointers, struct Binary_r);
+		bin_data->lpb = (uint8_t *) "";
+	}
+	else {
+		emsmdbp_source_key_from_fmid(header_data_pointers, emsmdbp_ctx, owner, *(uint64_t *) data_pointers[sync_data->prop_index.parent_fid], &bin_data);
+	}
+	query_props.aulPropTag[j] = PidTagParentSourceKey;
+	header_data_pointers[j] = bin_data;
+	j++;
+
+	/* source key */
+	eid = *(uint64_t *) data_pointers[sync_data->prop_index.eid];
+	if (eid == 0x7fffffffffffffffLL) {
+		OC_DEBUG(0, "folder without a valid eid\n");
+		talloc_free(header_data_pointers);
+		return 0;
+	}
+	emsmdbp_replid_to_guid(emsmdbp_ctx, owner, eid & 0xffff, &replica_guid);
+	RAWIDSET_push_guid_glob(sync_data->eid_set, &replica_guid, (eid >> 16) & 0x0000ffffffffffff);
+
+	/* bin_data = oxcfxics_make_gid(header_data_pointers, &sync_data->replica_guid, eid >> 16); */
+	emsmdbp_source_key_from_fmid(header_data_pointers, emsmdbp_ctx, owner, eid, &bin_data);
+	query_props.aulPropTag[j] = PidTagSourceKey;
+	header_data_pointers[j] = bin_data;
+	j++;
+
+	/* last modification time */
+	if (retvals[sync_data->prop_index.last_modification_time]) {
+		unix_time = oc_version_time;
+		unix_to_nt_time(&nt_time, unix_time);
+		lm_time = talloc_zero(header_data_pointers, struct FILETIME);
+		lm_time->dwLowDateTime = (nt_time & 0xffffffff);
+		lm_time->dwHighDateTime = nt_time >> 32;
+	}
+	else {
+		lm_time = (struct FILETIME *) data_pointers[sync_data->prop_index.last_modification_time];
+		nt_time = ((uint64_t) lm_time->dwHighDateTime << 32) | lm_time->dwLowDateTime;
+		unix_time = nt_time_to_unix(nt_time);
+	}
+	query_props.aulPropTag[j] = PidTagLastModificationTime;
+	header_data_pointers[j] = lm_time;
+	j++;
+
+	if (retvals[sync_data->prop_index.change_number]) {
+		OC_DEBUG(5, "mandatory property PidTagChangeNumber not returned for folder\n");
+		abort();
+	}
+	cn = ((*(uint64_t *) data_pointers[sync_data->prop_index.change_number]) >> 16) & 0x0000ffffffffffff;
+	if (IDSET_includes_guid_glob(synccontext->cnset_seen, &sync_data->replica_guid, cn)) {
+		synccontext->skipped_objects++;
+		OC_DEBUG(5, "folder changes: cn %.16"PRIx64" already present\n", cn);
+		if (retvals[sync_data->prop_index.change_key] == MAPI_E_SUCCESS) {
+			goto end;
+		}
+	}
+	RAWIDSET_push_guid_glob(sync_data->cnset_seen, &sync_data->replica_guid, cn);
+
+	/* change key */
+
+	/* When the SOGo backend generates the PidTagChangeKey for folders on first synchronization,
+	   it generates a PidTagChangeKey with the replicaID part filled with zeros. This property value
+	   is then used to populate the PidTagPredecessorChangeList. Using an empty replicaID is however
+	   causing Outlook to generate Synchronization Issues. If the PidTagPredecessorChangeList property
+	   is missing, it means we are synchronizing a folder for the first time. The following condition
+	   therefore ensures that a proper PidTagChangeKey is generated to comply with Outlook requirements.
+	*/
+	if ((retvals[sync_data->prop_index.change_key] != MAPI_E_SUCCESS) ||
+	    ((retvals[sync_data->prop_index.change_key] == MAPI_E_SUCCESS) &&
+	     (retvals[sync_data->prop_index.predecessor_change_list] != MAPI_E_SUCCESS))) {
+		bin_data = oxcfxics_make_gid(header_data_pointers, &sync_data->replica_guid, cn);
+	} else {
+		bin_data = data_pointers[sync_data->prop_index.change_key];
+	}
+
+
+	query_props.aulPropTag[j] = PidTagChangeKey;
+	header_data_pointers[j] = bin_data;
+	j++;
+
+	/* predecessor... (already computed) */
+	query_props.aulPropTag[j] = PidTagPredecessorChangeList;
+	if (retvals[sync_data->prop_index.predecessor_change_list] != MAPI_E_SUCCESS) {
+		predecessors_data.cb = bin_data->cb + 1;
+		predecessors_data.lpb = talloc_array(header_data_pointers, uint8_t, predecessors_data.cb);
+		*predecessors_data.lpb = bin_data->cb & 0xff;
+		memcpy(predecessors_data.lpb + 1, bin_data->lpb, bin_data->cb);
+		header_data_pointers[j] = &predecessors_data;
+	}
+	else {
+		bin_data = data_pointers[sync_data->prop_index.predecessor_change_list];
+		header_data_pointers[j] = bin_data;
+	}
+	j++;
+			
+	/* display name */
+	query_props.aulPropTag[j] = PidTagDisplayName;
+	if (retvals[sync_data->prop_index.display_name]) {
+		header_data_pointers[j] = "";
+	}
+	else {
+		header_data_pointers[j] = data_pointers[sync_data->prop_index.display_name];
+	}
+	j++;
+	
+	/* folder id (conditional) */
+	if (synccontext->request.request_eid) {
+		query_props.aulPropTag[j] = PidTagFolderId;
+		header_data_pointers[j] = data_pointers[sync_data->prop_index.eid];
+		j++;
+	}
+
+	/* parent folder id (conditional) */
+	if (synccontext->request.no_foreign_identifiers) {
+		query_props.aulPropTag[j] = PidTagParentFolderId;
+		header_data_pointers[j] = data_pointers[sync_data->prop_index.parent_fid];
+		if (retvals[sync_data->prop_index.parent_fid]) {
+			header_data_pointers[j] = talloc_zero(header_data_pointers, uint64_t);
+		}
+		else {
+			header_data_pointers[j] = data_pointers[sync_data->prop_index.parent_fid];
+		}
+		j++;
+	}
+	
+	query_props.cValues = j;
+
+	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncChg);
+	oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
+	oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, header_data_pointers, (enum MAPISTATUS *) header_retvals);
+
+	/** remaining props */
+	if (table_object->object.table->prop_count > folder_properties_shift) {
+		query_props.cValues = table_object->object.table->prop_count - folder_properties_shift;
+		query_props.aulPropTag = table_object->object.table->properties + folder_properties_shift;
+		oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->segments, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, data_pointers + folder_properties_shift, (enum MAPISTATUS *) retvals + folder_properties_shift);
+	}
+
+	synccontext->sent_objects++;
+end:
+	talloc_free(header_data_pointers);
+
+	return eid;
+}
+
+/**
+   \details Open the hierarchy table of a folder and return a cursor
+   on its first row
+
+   \return the cursor on success, NULL if the folder has no hierarchy table
+ */
+static struct oxcfxics_folder_sync_cursor *oxcfxics_folder_sync_cursor_open(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object_synccontext *synccontext, const char *owner, struct emsmdbp_object *folder_object)
+{
+	struct oxcfxics_folder_sync_cursor	*cursor;
+	struct emsmdbp_object			*table_object;
+	uint32_t				contextID;
 
-	contextID = emsmdbp_get_contextID(folder_object);
+	cursor = talloc_zero(NULL, struct oxcfxics_folder_sync_cursor);
+	if (!cursor) return NULL;
 
-	/* 2b. we build the stream */
-	table_object = emsmdbp_folder_open_table(mem_ctx, folder_object, MAPISTORE_FOLDER_TABLE, 0); 
+	table_object = emsmdbp_folder_open_table(cursor, folder_object, MAPISTORE_FOLDER_TABLE, 0);
 	if (!table_object) {
 		OC_DEBUG(5, "folder does not handle hierarchy tables\n");
-		return;
+		talloc_free(cursor);
+		return NULL;
 	}
 
 	table_object->object.table->prop_count = synccontext->properties.cValues;
 	table_object->object.table->properties = synccontext->properties.aulPropTag;
 	oxcfxics_table_set_cn_restriction(emsmdbp_ctx, table_object, owner, synccontext->cnset_seen);
 	if (emsmdbp_is_mapistore(table_object)) {
+		contextID = emsmdbp_get_contextID(folder_object);
 		mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, contextID,
 					    table_object->backend_object, synccontext->properties.cValues, synccontext->properties.aulPropTag);
 		mapistore_table_get_row_count(emsmdbp_ctx->mstore_ctx, contextID, table_object->backend_object, MAPISTORE_PREFILTERED_QUERY, &table_object->object.table->denominator);
 		synccontext->total_objects += table_object->object.table->denominator;
 	}
 
-	for (i = 0; i < table_object->object.table->denominator; i++) {
-		data_pointers = emsmdbp_object_table_get_row_props(mem_ctx, emsmdbp_ctx, table_object, i, MAPISTORE_PREFILTERED_QUERY, &retvals);
-		if (data_pointers) {
-			/** fixed header props */
-			header_data_pointers = talloc_array(NULL, void *, 8);
-			header_retvals = talloc_array(header_data_pointers, enum MAPISTATUS, 8);
-			memset(header_retvals, 0, 8 * sizeof(uint32_t));
-			query_props.aulPropTag = talloc_array(header_data_pointers, enum MAPITAGS, 8);
-
-			j = 0;
-
-			/* parent source key */
-			if (folder_object == topmost_folder_object) {
-				/* No parent source key at the first hierarchy level */
-				bin_data = talloc_zero(header_data_pointers, struct Binary_r);
-				bin_data->lpb = (uint8_t *) "";
-			}
-			else {
-				emsmdbp_source_key_from_fmid(header_data_pointers, emsmdbp_ctx, owner, *(uint64_t *) data_pointers[sync_data->prop_index.parent_fid], &bin_data);
-			}
-			query_props.aulPropTag[j] = PidTagParentSourceKey;
-			header_data_pointers[j] = bin_data;
-			j++;
-
-			/* source key */
-			eid = *(uint64_t *) data_pointers[sync_data->prop_index.eid];
-			if (eid == 0x7fffffffffffffffLL) {
-				OC_DEBUG(0, "folder without a valid eid\n");
-				talloc_free(header_data_pointers);
-				continue;
-			}
-			emsmdbp_replid_to_guid(emsmdbp_ctx, owner, eid & 0xffff, &replica_guid);
-			RAWIDSET_push_guid_glob(sync_data->eid_set, &replica_guid, (eid >> 16) & 0x0000ffffffffffff);
+	cursor->folder_object = folder_object;
+	cursor->table_object = table_object;
 
-			/* bin_data = oxcfxics_make_gid(header_data_pointers, &sync_data->replica_guid, eid >> 16); */
-			emsmdbp_source_key_from_fmid(header_data_pointers, emsmdbp_ctx, owner, eid, &bin_data);
-			query_props.aulPropTag[j] = PidTagSourceKey;
-			header_data_pointers[j] = bin_data;
-			j++;
-
-			/* last modification time */
-			if (retvals[sync_data->prop_index.last_modification_time]) {
-				unix_time = oc_version_time;
-				unix_to_nt_time(&nt_time, unix_time);
-				lm_time = talloc_zero(header_data_pointers, struct FILETIME);
-				lm_time->dwLowDateTime = (nt_time & 0xffffffff);
-				lm_time->dwHighDateTime = nt_time >> 32;
-			}
-			else {
-				lm_time = (struct FILETIME *) data_pointers[sync_data->prop_index.last_modification_time];
-				nt_time = ((uint64_t) lm_time->dwHighDateTime << 32) | lm_time->dwLowDateTime;
-				unix_time = nt_time_to_unix(nt_time);
-			}
-			query_props.aulPropTag[j] = PidTagLastModificationTime;
-			header_data_pointers[j] = lm_time;
-			j++;
+	return cursor;
+}
 
-			if (retvals[sync_data->prop_index.change_number]) {
-				OC_DEBUG(5, "mandatory property PidTagChangeNumber not returned for folder\n");
-				abort();
-			}
-			cn = ((*(uint64_t *) data_pointers[sync_data->prop_index.change_number]) >> 16) & 0x0000ffffffffffff;
-			if (IDSET_includes_guid_glob(synccontext->cnset_seen, &sync_data->replica_guid, cn)) {
-				synccontext->skipped_objects++;
-				OC_DEBUG(5, "folder changes: cn %.16"PRIx64" already present\n", cn);
-				if (retvals[sync_data->prop_index.change_key] == MAPI_E_SUCCESS) {
-					goto end_row;
-				}
-			}
-			RAWIDSET_push_guid_glob(sync_data->cnset_seen, &sync_data->replica_guid, cn);
-
-			/* change key */
-
-			/* When the SOGo backend generates the PidTagChangeKey for folders on first synchronization,
-			   it generates a PidTagChangeKey with the replicaID part filled with zeros. This property value
-			   is then used to populate the PidTagPredecessorChangeList. Using an empty replicaID is however
-			   causing Outlook to generate Synchronization Issues. If the PidTagPredecessorChangeList property
-			   is missing, it means we are synchronizing a folder for the first time. The following condition
-			   therefore ensures that a proper PidTagChangeKey is generated to comply with Outlook requirements.
-			*/
-			if ((retvals[sync_data->prop_index.change_key] != MAPI_E_SUCCESS) ||
-			    ((retvals[sync_data->prop_index.change_key] == MAPI_E_SUCCESS) &&
-			     (retvals[sync_data->prop_index.predecessor_change_list] != MAPI_E_SUCCESS))) {
-				bin_data = oxcfxics_make_gid(header_data_pointers, &sync_data->replica_guid, cn);
-			} else {
-				bin_data = data_pointers[sync_data->prop_index.change_key];
-			}
+/**
+   \details Close the cursor on top of the walk stack and return its parent
 
+   The whole subtree of the folder has been walked: its highest change
+   number is stored when openchangedb did not know it yet, and carried
+   over to the parent.
+ */
+static struct oxcfxics_folder_sync_cursor *oxcfxics_folder_sync_cursor_close(struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct oxcfxics_sync_data *sync_data, struct oxcfxics_folder_sync_cursor *cursor, struct emsmdbp_object *topmost_folder_object)
+{
+	struct oxcfxics_folder_sync_cursor	*parent;
+	struct emsmdbp_object			*folder_object;
+	uint64_t				fid;
 
-			query_props.aulPropTag[j] = PidTagChangeKey;
-			header_data_pointers[j] = bin_data;
-			j++;
+	parent = cursor->parent;
+	folder_object = cursor->folder_object;
 
-			/* predecessor... (already computed) */
-			query_props.aulPropTag[j] = PidTagPredecessorChangeList;
-			if (retvals[sync_data->prop_index.predecessor_change_list] != MAPI_E_SUCCESS) {
-				predecessors_data.cb = bin_data->cb + 1;
-				predecessors_data.lpb = talloc_array(header_data_pointers, uint8_t, predecessors_data.cb);
-				*predecessors_data.lpb = bin_data->cb & 0xff;
-				memcpy(predecessors_data.lpb + 1, bin_data->lpb, bin_data->cb);
-				header_data_pointers[j] = &predecessors_data;
-			}
-			else {
-				bin_data = data_pointers[sync_data->prop_index.predecessor_change_list];
-				header_data_pointers[j] = bin_data;
-			}
-			j++;
-					
-			/* display name */
-			query_props.aulPropTag[j] = PidTagDisplayName;
-			if (retvals[sync_data->prop_index.display_name]) {
-				header_data_pointers[j] = "";
-			}
-			else {
-				header_data_pointers[j] = data_pointers[sync_data->prop_index.display_name];
-			}
-			j++;
-			
-			/* folder id (conditional) */
-			if (synccontext->request.request_eid) {
-				query_props.aulPropTag[j] = PidTagFolderId;
-				header_data_pointers[j] = data_pointers[sync_data->prop_index.eid];
-				j++;
-			}
+	/* unchanged rows were filtered out up to the change set seen by the client */
+	if (cursor->hierarchy_cn < sync_data->hierarchy_cn_seen) {
+		cursor->hierarchy_cn = sync_data->hierarchy_cn_seen;
+	}
+	if (sync_data->hierarchy_cns && cursor->store_hierarchy_cn && !cursor->partial && cursor->hierarchy_cn) {
+		fid = oxcfxics_folder_object_fid(folder_object);
+		openchangedb_set_hierarchy_change_numbers(emsmdbp_ctx->oc_ctx, owner, 1, &fid, cursor->hierarchy_cn);
+	}
+	if (parent) {
+		if (parent->hierarchy_cn < cursor->hierarchy_cn) {
+			parent->hierarchy_cn = cursor->hierarchy_cn;
+		}
+		parent->partial |= cursor->partial;
+	}
 
-			/* parent folder id (conditional) */
-			if (synccontext->request.no_foreign_identifiers) {
-				query_props.aulPropTag[j] = PidTagParentFolderId;
-				header_data_pointers[j] = data_pointers[sync_data->prop_index.parent_fid];
-				if (retvals[sync_data->prop_index.parent_fid]) {
-					header_data_pointers[j] = talloc_zero(header_data_pointers, uint64_t);
-				}
-				else {
-					header_data_pointers[j] = data_pointers[sync_data->prop_index.parent_fid];
-				}
-				j++;
+	/* the table refers to its folder, release it first */
+	talloc_free(cursor);
+	if (folder_object != topmost_folder_object) {
+		talloc_free(folder_object);
+	}
+
+	return parent;
+}
+
+/**
+   \details Walk the hierarchy depth first and push the folder changes
+   until the chunk reaches max_hierarchy_sync_size or, once it holds a
+   folder, the call spent its time slice. The walk position is kept in
+   sync_data so the next chunk resumes from there.
+
+   \return true when the whole hierarchy has been pushed
+ */
+static bool oxcfxics_push_folderChange(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object_synccontext *synccontext, const char *owner, struct emsmdbp_object *topmost_folder_object, struct oxcfxics_sync_data *sync_data)
+{
+	struct oxcfxics_folder_sync_cursor	*cursor, *subfolder_cursor;
+	struct emsmdbp_object			*subfolder_object;
+	uint64_t				eid, cn;
+	enum MAPISTATUS				*retvals;
+	enum mapistore_error			retval;
+	void					**data_pointers;
+	uint32_t				chunk_start;
+
+	chunk_start = sync_data->ndr->offset;
+	while (sync_data->folder_cursor && sync_data->ndr->offset < max_hierarchy_sync_size &&
+	       (sync_data->ndr->offset == chunk_start || !emsmdbp_sched_yield(emsmdbp_ctx))) {
+		cursor = sync_data->folder_cursor;
+		if (cursor->next_row >= cursor->table_object->object.table->denominator) {
+			sync_data->folder_cursor = oxcfxics_folder_sync_cursor_close(emsmdbp_ctx, owner, sync_data, cursor, topmost_folder_object);
+			continue;
+		}
+
+		data_pointers = emsmdbp_object_table_get_row_props(NULL, emsmdbp_ctx, cursor->table_object, cursor->next_row, MAPISTORE_PREFILTERED_QUERY, &retvals);
+		cursor->next_row++;
+		if (!data_pointers) {
+			cursor->partial = true;
+			continue;
+		}
+
+		if (retvals[sync_data->prop_index.change_number] == MAPI_E_SUCCESS) {
+			cn = *(uint64_t *) data_pointers[sync_data->prop_index.change_number];
+			if (cursor->hierarchy_cn < cn) {
+				cursor->hierarchy_cn = cn;
 			}
-			
-			query_props.cValues = j;
-
-			ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncChg);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-			ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
-			oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, header_data_pointers, (enum MAPISTATUS *) header_retvals);
-
-			/** remaining props */
-			if (table_object->object.table->prop_count > folder_properties_shift) {
-				query_props.cValues = table_object->object.table->prop_count - folder_properties_shift;
-				query_props.aulPropTag = table_object->object.table->properties + folder_properties_shift;
-				oxcfxics_ndr_push_properties(sync_data->ndr, sync_data->cutmarks_ndr, emsmdbp_ctx->mstore_ctx->nprops_ctx, &query_props, data_pointers + folder_properties_shift, (enum MAPISTATUS *) retvals + folder_properties_shift);
+		}
+		eid = oxcfxics_push_folderChange_row(emsmdbp_ctx, synccontext, owner, topmost_folder_object, sync_data, cursor->folder_object, cursor->table_object, data_pointers, retvals);
+		talloc_free(data_pointers);
+		talloc_free(retvals);
+		if (!eid) {
+			cursor->partial = true;
+			continue;
+		}
+
+		/* subfolders whose hierarchy did not change are not opened */
+		if (oxcfxics_folder_hierarchy_is_seen(emsmdbp_ctx, owner, sync_data, eid, &cn)) {
+			OC_DEBUG(5, "folder changes: hierarchy of %.16"PRIx64" unchanged\n", eid);
+			if (cursor->hierarchy_cn < cn) {
+				cursor->hierarchy_cn = cn;
 			}
+			continue;
+		}
 
-			synccontext->sent_objects++;
-		end_row:
-			talloc_free(header_data_pointers);
-			talloc_free(data_pointers);
-			talloc_free(retvals);
+		/* subfolders are pushed right after their parent */
+		retval = emsmdbp_object_open_folder(NULL, emsmdbp_ctx, cursor->folder_object, eid, &subfolder_object);
+		if (retval != MAPISTORE_SUCCESS) {
+			OC_DEBUG(5, "[oxcfxics] Fail open folder %"PRIu64" from parent folder %"PRIu64" (retval %d)", eid, cursor->folder_object->object.folder->folderID, retval);
+			cursor->partial = true;
+			continue;
+		}
+		subfolder_cursor = oxcfxics_folder_sync_cursor_open(emsmdbp_ctx, synccontext, owner, subfolder_object);
+		if (!subfolder_cursor) {
+			talloc_free(subfolder_object);
+			continue;
+		}
+		subfolder_cursor->parent = cursor;
+		subfolder_cursor->hierarchy_cn = cn;
+		subfolder_cursor->store_hierarchy_cn = (cn == 0);
+		sync_data->folder_cursor = subfolder_cursor;
+	}
 
-			retval = emsmdbp_object_open_folder(NULL, emsmdbp_ctx, folder_object, eid, &subfolder_object);
-			if (retval == MAPISTORE_SUCCESS) {
-				oxcfxics_push_folderChange(emsmdbp_ctx, synccontext, owner, topmost_folder_object, sync_data, subfolder_object);
-				talloc_free(subfolder_object);
-			} else {
-				OC_DEBUG(5, "[oxcfxics] Fail open folder %"PRIu64" from parent folder %"PRIu64" (retval %d)", eid, folder_object->object.folder->folderID, retval);
-			}
+	return (sync_data->folder_cursor == NULL);
+}
+
+/**
+   \details Release the walk stack of a hierarchy synchronization the
+   client gave up before its end. The folders the walk opened are
+   released with their cursors; the topmost one belongs to the caller.
+ */
+static int oxcfxics_folder_sync_data_destructor(struct oxcfxics_sync_data *sync_data)
+{
+	struct oxcfxics_folder_sync_cursor	*cursor;
+	struct oxcfxics_folder_sync_cursor	*parent;
+	struct emsmdbp_object			*folder_object;
+
+	for (cursor = sync_data->folder_cursor; cursor; cursor = parent) {
+		parent = cursor->parent;
+		folder_object = cursor->folder_object;
+		talloc_free(cursor);
+		if (parent) {
+			talloc_free(folder_object);
 		}
 	}
+	sync_data->folder_cursor = NULL;
 
-	talloc_free(mem_ctx);
+	return 0;
 }
 
-static void oxcfxics_prepare_synccontext_with_folderChange(struct emsmdbp_object_synccontext *synccontext, TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct emsmdbp_object *parent_object)
+static void oxcfxics_fill_synccontext_with_folderChange(struct emsmdbp_object_synccontext *synccontext, TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct emsmdbp_object *parent_object)
 {
 	struct oxcfxics_sync_data		*sync_data;
 	struct idset				*new_idset, *old_idset;
+	uint64_t				hierarchy_cn;
+
+	/* hierarchySync = *folderChange [deletions] state IncrSyncEnd */
+
+	if (synccontext->sync_stage == 0) {
+		/* 1b. we setup context data */
+		sync_data = talloc_zero(synccontext, struct oxcfxics_sync_data);
+		talloc_set_destructor(sync_data, oxcfxics_folder_sync_data_destructor);
+		openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, owner, NULL, &sync_data->replica_guid);
+		SPropTagArray_find(synccontext->properties, PidTagParentFolderId, &sync_data->prop_index.parent_fid);
+		SPropTagArray_find(synccontext->properties, PidTagFolderId, &sync_data->prop_index.eid);
+		SPropTagArray_find(synccontext->properties, PidTagChangeNumber, &sync_data->prop_index.change_number);
+		SPropTagArray_find(synccontext->properties, PidTagChangeKey, &sync_data->prop_index.change_key);
+		SPropTagArray_find(synccontext->properties, PidTagPredecessorChangeList, &sync_data->prop_index.predecessor_change_list);
+		SPropTagArray_find(synccontext->properties, PidTagLastModificationTime, &sync_data->prop_index.last_modification_time);
+		SPropTagArray_find(synccontext->properties, PidTagDisplayName, &sync_data->prop_index.display_name);
+		sync_data->cnset_seen = RAWIDSET_make(sync_data, false, true);
+		sync_data->eid_set = RAWIDSET_make(sync_data, false, false);
 
-	/* 1b. we setup context data */
-	sync_data = talloc_zero(NULL, struct oxcfxics_sync_data);
-	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, owner, NULL, &sync_data->replica_guid);
-	SPropTagArray_find(synccontext->properties, PidTagParentFolderId, &sync_data->prop_index.parent_fid);
-	SPropTagArray_find(synccontext->properties, PidTagFolderId, &sync_data->prop_index.eid);
-	SPropTagArray_find(synccontext->properties, PidTagChangeNumber, &sync_data->prop_index.change_number);
-	SPropTagArray_find(synccontext->properties, PidTagChangeKey, &sync_data->prop_index.change_key);
-	SPropTagArray_find(synccontext->properties, PidTagPredecessorChangeList, &sync_data->prop_index.predecessor_change_list);
-	SPropTagArray_find(synccontext->properties, PidTagLastModificationTime, &sync_data->prop_index.last_modification_time);
-	SPropTagArray_find(synccontext->properties, PidTagDisplayName, &sync_data->prop_index.display_name);
+		/* An unchanged hierarchy is an empty delta, no folder is opened */
+		sync_data->hierarchy_cns = emsmdbp_is_mailboxstore(parent_object);
+		if (!oxcfxics_cnset_get_high_watermark(emsmdbp_ctx, owner, synccontext->cnset_seen, &sync_data->hierarchy_cn_seen)) {
+			sync_data->hierarchy_cn_seen = 0;
+		}
+		if (oxcfxics_folder_hierarchy_is_seen(emsmdbp_ctx, owner, sync_data, oxcfxics_folder_object_fid(parent_object), &hierarchy_cn)) {
+			OC_DEBUG(5, "folder changes: hierarchy unchanged since %.16"PRIx64"\n", sync_data->hierarchy_cn_seen);
+		}
+		else {
+			sync_data->folder_cursor = oxcfxics_folder_sync_cursor_open(emsmdbp_ctx, synccontext, owner, parent_object);
+			if (sync_data->folder_cursor) {
+				sync_data->folder_cursor->store_hierarchy_cn = (hierarchy_cn == 0);
+			}
+		}
+
+		synccontext->sync_data = sync_data;
+		synccontext->sync_stage = 1;
+	}
+	else {
+		sync_data = synccontext->sync_data;
+		talloc_free(sync_data->ndr);
+		talloc_free(sync_data->segments);
+	}
 	sync_data->ndr = ndr_push_init_ctx(sync_data);
 	ndr_set_flags(&sync_data->ndr->flags, LIBNDR_FLAG_NOALIGN);
 	sync_data->ndr->offset = 0;
-	sync_data->cutmarks_ndr = ndr_push_init_ctx(sync_data);
-	ndr_set_flags(&sync_data->cutmarks_ndr->flags, LIBNDR_FLAG_NOALIGN);
-	sync_data->cutmarks_ndr->offset = 0;
-	sync_data->cnset_seen = RAWIDSET_make(sync_data, false, true);
-	sync_data->eid_set = RAWIDSET_make(sync_data, false, false);
+	sync_data->segments = oxcfxics_stream_segments_init(sync_data);
 
-	oxcfxics_push_folderChange(emsmdbp_ctx, synccontext, owner, parent_object, sync_data, parent_object);
+	if (synccontext->sync_stage == 1) {
+		/* 2b. we build the stream */
+		if (oxcfxics_push_folderChange(emsmdbp_ctx, synccontext, owner, parent_object, sync_data)) {
+			synccontext->sync_stage = 3;
+		}
+	}
 
-	/* deletions (mapistore v2) */
+	if (synccontext->sync_stage == 3) {
+		/* deletions (mapistore v2) */
 
-	/* state */
-	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncStateBegin);
+		/* state */
+		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncStateBegin);
 
-	new_idset = RAWIDSET_convert_to_idset(NULL, sync_data->cnset_seen);
-	old_idset = synccontext->cnset_seen;
-	/* IDSET_dump (synccontext->cnset_seen, "initial cnset_seen (folder change)"); */
-	synccontext->cnset_seen = IDSET_merge_idsets(synccontext, old_idset, new_idset);
-	/* IDSET_dump (synccontext->cnset_seen, "merged cnset_seen (folder change)"); */
-	talloc_free(old_idset);
-	talloc_free(new_idset);
+		new_idset = RAWIDSET_convert_to_idset(NULL, sync_data->cnset_seen);
+		old_idset = synccontext->cnset_seen;
+		/* IDSET_dump (synccontext->cnset_seen, "initial cnset_seen (folder change)"); */
+		synccontext->cnset_seen = IDSET_merge_idsets(synccontext, old_idset, new_idset);
+		/* IDSET_dump (synccontext->cnset_seen, "merged cnset_seen (folder change)"); */
+		talloc_free(old_idset);
+		talloc_free(new_idset);
 
-	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagCnsetSeen);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
-	ndr_push_idset(sync_data->ndr, synccontext->cnset_seen);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagCnsetSeen);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
+		ndr_push_idset(sync_data->ndr, synccontext->cnset_seen);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
-	new_idset = RAWIDSET_convert_to_idset(NULL, sync_data->eid_set);
-	old_idset = synccontext->idset_given;
-	/* IDSET_dump (synccontext->idset_given, "initial idset_given (folder change)"); */
-	synccontext->idset_given = IDSET_merge_idsets(synccontext, old_idset, new_idset);
-	/* IDSET_dump (synccontext->idset_given, "merged idset_given (folder change)"); */
-	talloc_free(old_idset);
-	talloc_free(new_idset);
+		new_idset = RAWIDSET_convert_to_idset(NULL, sync_data->eid_set);
+		old_idset = synccontext->idset_given;
+		/* IDSET_dump (synccontext->idset_given, "initial idset_given (folder change)"); */
+		synccontext->idset_given = IDSET_merge_idsets(synccontext, old_idset, new_idset);
+		/* IDSET_dump (synccontext->idset_given, "merged idset_given (folder change)"); */
+		talloc_free(old_idset);
+		talloc_free(new_idset);
 
-	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagIdsetGiven);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
-	ndr_push_idset(sync_data->ndr, synccontext->idset_given);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, MetaTagIdsetGiven);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
+		ndr_push_idset(sync_data->ndr, synccontext->idset_given);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
-	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncStateEnd);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
+		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncStateEnd);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
-	/* end of stream */
-	ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncEnd);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, sync_data->ndr->offset);
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0);
+		/* end of stream */
+		ndr_push_uint32(sync_data->ndr, NDR_SCALARS, IncrSyncEnd);
+		oxcfxics_stream_segment_push(sync_data->segments, 0, sync_data->ndr->offset);
 
-	ndr_push_uint32(sync_data->cutmarks_ndr, NDR_SCALARS, 0xffffffff);
+		synccontext->sync_stage = 4;
+	}
 
-	synccontext->cutmarks = (uint32_t *) sync_data->cutmarks_ndr->data;
-	synccontext->next_cutmark_idx = 1;
+	synccontext->segments = sync_data->segments;
 	synccontext->stream.position = 0;
 	synccontext->stream.buffer.data = sync_data->ndr->data;
 	synccontext->stream.buffer.length = sync_data->ndr->offset;
 
-	(void) talloc_reference(synccontext, sync_data->ndr->data);
-	(void) talloc_reference(synccontext, sync_data->cutmarks_ndr->data);
-	talloc_free(sync_data);
+	if (synccontext->sync_stage == 4) {
+		(void) talloc_steal(synccontext, sync_data->ndr->data);
+		(void) talloc_steal(synccontext, sync_data->segments);
+		talloc_free(sync_data);
+		synccontext->sync_data = NULL;
+	}
+}
+
+/**
+   \details Produce the next chunk of the synchronization stream
+ */
+static void oxcfxics_fill_synccontext(struct emsmdbp_object_synccontext *synccontext, TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, const char *owner, struct emsmdbp_object *parent_object)
+{
+	if (synccontext->request.contents_mode) {
+		oxcfxics_fill_synccontext_with_messageChange(synccontext, mem_ctx, emsmdbp_ctx, owner, parent_object);
+	}
+	else {
+		oxcfxics_fill_synccontext_with_folderChange(synccontext, mem_ctx, emsmdbp_ctx, owner, parent_object);
+	}
 }
 
 static inline void oxcfxics_fill_ftcontext_fasttransfer_response(struct FastTransferSourceGetBuffer_repl *response, uint32_t request_buffer_size, TALLOC_CTX *mem_ctx, struct emsmdbp_object_ftcontext *ftcontext, struct emsmdbp_context *emsmdbp_ctx)
 {
-	uint32_t buffer_size, min_value_buffer, mark_idx, max_cutmark;
+	uint32_t buffer_size;
 
 	buffer_size = request_buffer_size;
 
 	if (ftcontext->stream.position == 0) {
 		ftcontext->steps = 0;
 		ftcontext->total_steps = (ftcontext->stream.buffer.length / request_buffer_size) + 1;
-		ftcontext->next_cutmark_idx = 1;
-		oxcfxics_check_cutmark_buffer(ftcontext->cutmarks, &ftcontext->stream.buffer);
+		if (ftcontext->segments) {
+			ftcontext->segments->next = 0;
+		}
 		OC_DEBUG(5, "fast transfer buffer is %d bytes long\n", (uint32_t) ftcontext->stream.buffer.length);
 	}
 	ftcontext->steps += 1;
 
 	if (ftcontext->stream.position + request_buffer_size < ftcontext->stream.buffer.length) {
-		mark_idx = ftcontext->next_cutmark_idx;
-		max_cutmark = ftcontext->stream.position + request_buffer_size;
-		/* FIXME: cutmark lookups would be faster using a binary search */
-		while (ftcontext->cutmarks[mark_idx] != 0xffffffff && ftcontext->cutmarks[mark_idx] < max_cutmark) {
-			buffer_size = ftcontext->cutmarks[mark_idx] - ftcontext->stream.position;
-			mark_idx += 2;
-		}
-		if (buffer_size < request_buffer_size && ftcontext->cutmarks[mark_idx] != 0xffffffff) {
-			min_value_buffer = ftcontext->cutmarks[mark_idx-1];
-			if (min_value_buffer && (request_buffer_size - buffer_size > min_value_buffer)) {
-				buffer_size = request_buffer_size;
-			}
-		}
-		ftcontext->next_cutmark_idx = mark_idx;
+		buffer_size = oxcfxics_stream_segments_slice(ftcontext->segments, ftcontext->stream.position, request_buffer_size);
 	}
 	
 	response->TransferBuffer = emsmdbp_stream_read_buffer(&ftcontext->stream, buffer_size);
@@ -1720,30 +2097,6 @@ static inline void oxcfxics_fill_ftcontext_fasttransfer_response(struct FastTran
 	}
 }
 
-static uint32_t oxcfxics_advance_cutmarks(struct emsmdbp_object_synccontext *synccontext, uint32_t request_buffer_size)
-{
-	uint32_t buffer_size, min_value_buffer, mark_idx, max_cutmark;
-
-	buffer_size = request_buffer_size;
-
-	mark_idx = synccontext->next_cutmark_idx;
-	max_cutmark = synccontext->stream.position + request_buffer_size;
-	/* FIXME: cutmark lookups would be faster using a binary search */
-	while (synccontext->cutmarks[mark_idx] != 0xffffffff && synccontext->cutmarks[mark_idx] < max_cutmark) {
-		buffer_size = synccontext->cutmarks[mark_idx] - synccontext->stream.position;
-		mark_idx += 2;
-	}
-	if (buffer_size < request_buffer_size && synccontext->cutmarks[mark_idx] != 0xffffffff) {
-		min_value_buffer = synccontext->cutmarks[mark_idx-1];
-		if (min_value_buffer && (request_buffer_size - buffer_size > min_value_buffer)) {
-			buffer_size = request_buffer_size;
-		}
-	}
-	synccontext->next_cutmark_idx = mark_idx;
-
-	return buffer_size;
-}
-
 
 static inline void oxcfxics_fill_synccontext_fasttransfer_response(struct FastTransferSourceGetBuffer_repl *response, uint32_t request_buffer_size, TALLOC_CTX *mem_ctx, struct emsmdbp_object_synccontext *synccontext, struct emsmdbp_object *parent_object)
 {
@@ -1758,94 +2111,71 @@ static inline void oxcfxics_fill_synccontext_fasttransfer_response(struct FastTr
 	OC_DEBUG(5, "start syncstream: position = %zu, size = %zu\n", synccontext->stream.position, synccontext->stream.buffer.length);
 	if (synccontext->stream.position + request_buffer_size < synccontext->stream.buffer.length) {
 		/* the current chunk has not been "emptied" yet */
-		buffer_size = oxcfxics_advance_cutmarks(synccontext, request_buffer_size);
+		buffer_size = oxcfxics_stream_segments_slice(synccontext->segments, synccontext->stream.position, request_buffer_size);
 		response->TransferBuffer = emsmdbp_stream_read_buffer(&synccontext->stream, buffer_size);
 	}
 	else {
 		/* the current chunk not does exist or we reached its end */
-		if (synccontext->request.contents_mode) {
-			OC_DEBUG(5, "content mode, stage %d\n", synccontext->sync_stage);
-			if (synccontext->sync_stage == 4) {
-				/* the last chunk was the last one */
-				end_of_buffer = true;
-				response->TransferBuffer = emsmdbp_stream_read_buffer(&synccontext->stream, request_buffer_size);
-			}
-			else if (synccontext->sync_stage == 0) {
-				/* no chunk sent yet, so we create a new one */
-				oxcfxics_fill_synccontext_with_messageChange(synccontext, mem_ctx, parent_object->emsmdbp_ctx, owner, parent_object);
-				oxcfxics_check_cutmark_buffer(synccontext->cutmarks, &synccontext->stream.buffer);
-				if (request_buffer_size < synccontext->stream.buffer.length) {
-					buffer_size = oxcfxics_advance_cutmarks(synccontext, request_buffer_size);
-				}
-				else {
-					buffer_size = request_buffer_size;
-					if (synccontext->sync_stage == 4) {
-						end_of_buffer = true;
-					}
-					else {
-						abort();
-					}
-				}
-				response->TransferBuffer = emsmdbp_stream_read_buffer(&synccontext->stream, buffer_size);
+		OC_DEBUG(5, "%s mode, stage %d\n", synccontext->request.contents_mode ? "content" : "hierarchy", synccontext->sync_stage);
+		if (synccontext->sync_stage == 4) {
+			/* the last chunk was the last one */
+			end_of_buffer = true;
+			response->TransferBuffer = emsmdbp_stream_read_buffer(&synccontext->stream, request_buffer_size);
+		}
+		else if (synccontext->sync_stage == 0) {
+			/* no chunk sent yet, so we create a new one */
+			oxcfxics_fill_synccontext(synccontext, mem_ctx, parent_object->emsmdbp_ctx, owner, parent_object);
+			if (request_buffer_size < synccontext->stream.buffer.length) {
+				buffer_size = oxcfxics_stream_segments_slice(synccontext->segments, synccontext->stream.position, request_buffer_size);
 			}
 			else {
-				/* we have reached the end of a middle chunk, we must thus finish it and complete the buffer with the content of the next chunk */
-				old_chunk_size = synccontext->stream.buffer.length - synccontext->stream.position;
-
-				if (old_chunk_size > 0) {
-					joint_buffer.length = old_chunk_size;
-					joint_buffer.data = talloc_memdup(mem_ctx, synccontext->stream.buffer.data + synccontext->stream.position, joint_buffer.length);
+				/* a chunk cut short by the time slice is sent whole */
+				buffer_size = request_buffer_size;
+				if (synccontext->sync_stage == 4) {
+					end_of_buffer = true;
 				}
+			}
+			response->TransferBuffer = emsmdbp_stream_read_buffer(&synccontext->stream, buffer_size);
+		}
+		else {
+			/* we have reached the end of a middle chunk, we must thus finish it and complete the buffer with the content of the next chunk */
+			old_chunk_size = synccontext->stream.buffer.length - synccontext->stream.position;
+			joint_buffer = data_blob_null;
 
-				oxcfxics_fill_synccontext_with_messageChange(synccontext, mem_ctx, parent_object->emsmdbp_ctx, owner, parent_object);
-				oxcfxics_check_cutmark_buffer(synccontext->cutmarks, &synccontext->stream.buffer);
+			if (old_chunk_size > 0) {
+				joint_buffer.length = old_chunk_size;
+				joint_buffer.data = talloc_memdup(mem_ctx, synccontext->stream.buffer.data + synccontext->stream.position, joint_buffer.length);
+			}
 
-				new_chunk_size = request_buffer_size - old_chunk_size;
-				if (synccontext->stream.buffer.length < new_chunk_size) {
-					new_chunk_size = synccontext->stream.buffer.length;
-					if (synccontext->sync_stage == 4) {
-						end_of_buffer = true;
-					}
-					else {
-						abort();
-					}
-				}
-				else {
-					new_chunk_size = oxcfxics_advance_cutmarks(synccontext, new_chunk_size);
-				}
+			oxcfxics_fill_synccontext(synccontext, mem_ctx, parent_object->emsmdbp_ctx, owner, parent_object);
 
-				if (new_chunk_size > 0) {
-					if (old_chunk_size) {
-						joint_buffer.length += new_chunk_size;
-						joint_buffer.data = talloc_realloc(mem_ctx, joint_buffer.data, uint8_t, joint_buffer.length);
-						memcpy(joint_buffer.data + old_chunk_size, synccontext->stream.buffer.data, new_chunk_size);
-						synccontext->stream.position += new_chunk_size;
-					}
-					else {
-						joint_buffer = emsmdbp_stream_read_buffer(&synccontext->stream, new_chunk_size);
-					}
+			new_chunk_size = request_buffer_size - old_chunk_size;
+			if (synccontext->stream.buffer.length < new_chunk_size) {
+				/* a chunk cut short by the time slice is sent whole */
+				new_chunk_size = synccontext->stream.buffer.length;
+				if (synccontext->sync_stage == 4) {
+					end_of_buffer = true;
 				}
-				response->TransferBuffer = joint_buffer;
-
-
-				OC_DEBUG(5, "joint buffers of sizes %zu and %zu\n", old_chunk_size, new_chunk_size);
-			}
-		}
-		else {
-			buffer_size = request_buffer_size;
-			if (synccontext->stream.buffer.data) {
-				end_of_buffer = true;
 			}
 			else {
-				oxcfxics_prepare_synccontext_with_folderChange(synccontext, mem_ctx, parent_object->emsmdbp_ctx, owner, parent_object);
-				oxcfxics_check_cutmark_buffer(synccontext->cutmarks, &synccontext->stream.buffer);
-				OC_DEBUG(5, "synccontext buffer is %u bytes long\n", (uint32_t) synccontext->stream.buffer.length);
+				new_chunk_size = oxcfxics_stream_segments_slice(synccontext->segments, synccontext->stream.position, new_chunk_size);
 			}
-			response->TransferBuffer = emsmdbp_stream_read_buffer(&synccontext->stream, buffer_size);
 
-			if (synccontext->stream.position == synccontext->stream.buffer.length) {
-				end_of_buffer = true;
+			if (new_chunk_size > 0) {
+				if (old_chunk_size) {
+					joint_buffer.length += new_chunk_size;
+					joint_buffer.data = talloc_realloc(mem_ctx, joint_buffer.data, uint8_t, joint_buffer.length);
+					memcpy(joint_buffer.data + old_chunk_size, synccontext->stream.buffer.data, new_chunk_size);
+					synccontext->stream.position += new_chunk_size;
+				}
+				else {
+					joint_buffer = emsmdbp_stream_read_buffer(&synccontext->stream, new_chunk_size);
+				}
 			}
+			response->TransferBuffer = joint_buffer;
+
+
+			OC_DEBUG(5, "joint buffers of sizes %zu and %zu\n", old_chunk_size, new_chunk_size);
 		}
 	}
 
@@ -1870,7 +2200,7 @@ static inline void oxcfxics_fill_synccontext_fasttransfer_response(struct FastTr
    \param mapi_req pointer to the FastTransferSourceGetBuffer EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the FastTransferSourceGetBuffer EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1927,6 +2257,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFastTransferSourceGetBuffer(TALLOC_CTX *mem_
 	if (request_buffer_size == 0xBABE) {
 		request_buffer_size = request->MaximumBufferSize.MaximumBufferSize;
 	}
+	request_buffer_size = emsmdbp_memory_buffer_size(emsmdbp_ctx, request_buffer_size);
 
 	/* Step 3. Perform the read operation */
 	switch (object->type) {
@@ -1946,8 +2277,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFastTransferSourceGetBuffer(TALLOC_CTX *mem_
 	response->Reserved = 0;
 
 end:
-	*size += libmapiserver_RopFastTransferSourceGetBuffer_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1959,7 +2288,7 @@ end:
    \param mapi_req pointer to the SyncConfigure EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncConfigure EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2196,8 +2525,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncConfigure(TALLOC_CTX *mem_ctx,
 	talloc_free(synccontext_object);
         handles[mapi_repl->handle_idx] = synccontext_rec->handle;
 end:
-	*size += libmapiserver_RopSyncConfigure_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -2209,7 +2536,7 @@ end:
    \param mapi_req pointer to the SyncImportMessageChange EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncImportMessageChange EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2303,6 +2630,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportMessageChange(TALLOC_CTX *mem_ctx,
 			goto end;
 		}
 		message_object->object.message->read_write = true;
+		emsmdbp_message_counts_track(emsmdbp_ctx, message_object, true);
 	}
 	else if (ret != MAPISTORE_SUCCESS) {
 		mapi_handles_delete(emsmdbp_ctx->handles_ctx, message_object_handle->handle);
@@ -2333,8 +2661,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportMessageChange(TALLOC_CTX *mem_ctx,
 				(message_object->object.message->messageID >> 16) & 0x0000ffffffffffff);
 
 end:
-	*size += libmapiserver_RopSyncImportMessageChange_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -2346,7 +2672,7 @@ end:
    \param mapi_req pointer to the SyncImportHierarchyChange EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncImportHierarchyChange EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2448,7 +2774,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportHierarchyChange(TALLOC_CTX *mem_ct
 
 	retval = emsmdbp_object_open_folder_by_fid(NULL, emsmdbp_ctx, parent_folder, folderID, &folder_object);
 	if (retval != MAPI_E_SUCCESS) {
-		retval = openchangedb_get_new_changeNumber(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, &cn);
+		retval = emsmdbp_change_number(emsmdbp_ctx, emsmdbp_ctx->username, &cn);
 		if (retval) {
 			OC_DEBUG(5, "unable to obtain a change number\n");
 			folder_object = NULL;
@@ -2499,8 +2825,6 @@ end:
 		talloc_free(parent_folder);
 	}
 
-	*size += libmapiserver_RopSyncImportHierarchyChange_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -2512,7 +2836,7 @@ end:
    \param mapi_req pointer to the SyncImportDeletes EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the SyncImportDeletes EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2535,6 +2859,8 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportDeletes(TALLOC_CTX *mem_ctx,
 	uint16_t				repl_id;
 	struct mapi_SBinaryArray		*object_array;
 	uint64_t				*object_ids = NULL;
+	uint64_t				*deleted_ids = NULL;
+	uint32_t				deleted_count = 0;
 	uint8_t					delete_type;
 	uint32_t				i;
 	int						ret;
@@ -2607,6 +2933,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportDeletes(TALLOC_CTX *mem_ctx,
 
 		contextID = emsmdbp_get_contextID(synccontext_object);
 
+		deleted_ids = talloc_array(object_ids, uint64_t, object_array->cValues);
+		if (!deleted_ids) {
+			mapi_repl->error_code = MAPI_E_NOT_ENOUGH_MEMORY;
+			goto end;
+		}
+
 		for (i = 0; i < object_array->cValues; i++) {
 			ret = oxcfxics_fmid_from_source_key(emsmdbp_ctx, owner, object_array->bin + i, &objectID);
 			if (ret == MAPISTORE_SUCCESS) {
@@ -2616,12 +2948,25 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportDeletes(TALLOC_CTX *mem_ctx,
 				} else {
 					OC_DEBUG(5, "message deletion failed for fmid: 0x%.16"PRIx64"\n", objectID);
 				}
-				ret = mapistore_indexing_record_del_mid(emsmdbp_ctx->mstore_ctx, contextID, owner, objectID, delete_type);
-				if (ret != MAPISTORE_SUCCESS) {
-					OC_DEBUG(5, "message deletion of index record failed for fmid: 0x%.16"PRIx64"\n", objectID);
-				}
+				deleted_ids[deleted_count++] = objectID;
 			}
 		}
+
+		emsmdbp_freebusy_messages_deleted(emsmdbp_ctx, synccontext_object->parent_object, deleted_count, deleted_ids);
+		emsmdbp_content_index_messages_deleted(emsmdbp_ctx, synccontext_object->parent_object, deleted_count, deleted_ids);
+		emsmdbp_tombstones_messages_deleted(emsmdbp_ctx, synccontext_object->parent_object, deleted_count, deleted_ids);
+		emsmdbp_conversations_messages_deleted(emsmdbp_ctx, synccontext_object->parent_object, deleted_count, deleted_ids);
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, synccontext_object->parent_object);
+		for (i = 0; i < deleted_count; i++) {
+			emsmdbp_search_message_removed(emsmdbp_ctx, synccontext_object->parent_object->object.folder->folderID, deleted_ids[i]);
+		}
+
+		/* Remove the index records in one go */
+		ret = mapistore_indexing_record_del_fmids(emsmdbp_ctx->mstore_ctx, contextID, owner,
+							  deleted_count, deleted_ids, delete_type);
+		if (ret != MAPISTORE_SUCCESS) {
+			OC_DEBUG(5, "message deletion of %"PRIu32" index records failed\n", deleted_count);
+		}
 	}
 
 	/* Store the fid in the involved fmids of the upload operations */
@@ -2638,8 +2983,6 @@ end:
 		talloc_free(object_ids);
 	}
 
-	*size += libmapiserver_RopSyncImportDeletes_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -2653,7 +2996,7 @@ end:
    \param mapi_repl pointer to the SyncUploadStateStreamBegin EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2717,8 +3060,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamBegin(TALLOC_CTX *mem_c
 	synccontext_object->object.synccontext->state_stream.buffer.data = talloc_zero(synccontext_object->object.synccontext, uint8_t);
 
 end:
-	*size += libmapiserver_RopSyncUploadStateStreamBegin_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -2730,7 +3071,7 @@ end:
    \param mapi_req pointer to the SyncUploadStateStreamContinue EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncUploadStateStreamContinue EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2791,8 +3132,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamContinue(TALLOC_CTX *me
 				    new_data);
 
 end:
-	*size += libmapiserver_RopSyncUploadStateStreamContinue_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -2842,7 +3181,7 @@ static enum MAPISTATUS oxcfxics_check_cnset(struct openchangedb_context *oc_ctx,
    \param mapi_req pointer to the SyncUploadStateStreamEnd EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncUploadStateStreamEnd EcDoRpc_MAPI_REPL  structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -2859,6 +3198,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamEnd(TALLOC_CTX *mem_ctx
 	struct idset				*parsed_idset, *old_idset = NULL;
 	enum MAPISTATUS				retval;
 	void					*data = NULL;
+	bool					validated;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCFXICS] RopSyncUploadStateStreamEnd (0x77)\n");
 
@@ -2899,14 +3239,22 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamEnd(TALLOC_CTX *mem_ctx
 		OC_DEBUG(5, "  synccontext is collector\n");
 	}
 
-	/* parse IDSET */
+	/* parse IDSET, unless the same state was already uploaded */
 	synccontext = synccontext_object->object.synccontext;
-	parsed_idset = IDSET_parse(synccontext, synccontext->state_stream.buffer, false);
+	parsed_idset = emsmdbp_syncstate_lookup(synccontext, emsmdbp_ctx, synccontext->state_property,
+						&synccontext->state_stream.buffer);
+	validated = (parsed_idset != NULL);
+	if (validated) {
+		OC_DEBUG(5, "state already uploaded in this session, not parsed again\n");
+	}
+	else {
+		parsed_idset = IDSET_parse(synccontext, synccontext->state_stream.buffer, false);
 
-	retval = IDSET_check_ranges(parsed_idset);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_repl->error_code = retval;
-		goto reset;
+		retval = IDSET_check_ranges(parsed_idset);
+		if (retval != MAPI_E_SUCCESS) {
+			mapi_repl->error_code = retval;
+			goto reset;
+		}
 	}
 
 	switch (synccontext->state_property) {
@@ -2921,10 +3269,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamEnd(TALLOC_CTX *mem_ctx
 		if (parsed_idset) {
 			parsed_idset->single = true;
 		}
-		retval = oxcfxics_check_cnset(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, parsed_idset, "cnset_seen");
-		if (retval != MAPI_E_SUCCESS) {
-			mapi_repl->error_code = retval;
-			goto reset;
+		if (!validated) {
+			retval = oxcfxics_check_cnset(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, parsed_idset, "cnset_seen");
+			if (retval != MAPI_E_SUCCESS) {
+				mapi_repl->error_code = retval;
+				goto reset;
+			}
 		}
 		old_idset = synccontext->cnset_seen;
 		synccontext->cnset_seen = parsed_idset;
@@ -2933,10 +3283,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamEnd(TALLOC_CTX *mem_ctx
 		if (parsed_idset) {
 			parsed_idset->single = true;
 		}
-		retval = oxcfxics_check_cnset(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, parsed_idset, "cnset_seen_fai");
-		if (retval != MAPI_E_SUCCESS) {
-			mapi_repl->error_code = retval;
-			goto reset;
+		if (!validated) {
+			retval = oxcfxics_check_cnset(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, parsed_idset, "cnset_seen_fai");
+			if (retval != MAPI_E_SUCCESS) {
+				mapi_repl->error_code = retval;
+				goto reset;
+			}
 		}
 		old_idset = synccontext->cnset_seen_fai;
 		synccontext->cnset_seen_fai = parsed_idset;
@@ -2945,10 +3297,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamEnd(TALLOC_CTX *mem_ctx
 		if (parsed_idset) {
 			parsed_idset->single = true;
 		}
-		retval = oxcfxics_check_cnset(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, parsed_idset, "cnset_seen_read");
-		if (retval != MAPI_E_SUCCESS) {
-			mapi_repl->error_code = retval;
-			goto reset;
+		if (!validated) {
+			retval = oxcfxics_check_cnset(emsmdbp_ctx->oc_ctx, emsmdbp_ctx->username, parsed_idset, "cnset_seen_read");
+			if (retval != MAPI_E_SUCCESS) {
+				mapi_repl->error_code = retval;
+				goto reset;
+			}
 		}
 		old_idset = synccontext->cnset_read;
 		synccontext->cnset_read = parsed_idset;
@@ -2957,6 +3311,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncUploadStateStreamEnd(TALLOC_CTX *mem_ctx
 	if (old_idset) {
 		talloc_free(old_idset);
 	}
+	if (!validated) {
+		emsmdbp_syncstate_store(emsmdbp_ctx, synccontext->state_property, &synccontext->state_stream.buffer, parsed_idset);
+	}
 
 reset:
 	/* reset synccontext state */
@@ -2964,13 +3321,12 @@ reset:
 		talloc_free(synccontext->state_stream.buffer.data);
 		synccontext->state_stream.buffer.data = talloc_zero(synccontext, uint8_t);
 		synccontext->state_stream.buffer.length = 0;
+		synccontext->state_stream.capacity = 0;
 	}
 
 	synccontext->state_property = 0;
 
 end:
-	*size += libmapiserver_RopSyncUploadStateStreamEnd_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -3010,7 +3366,7 @@ static bool convertIdToFMID(const struct GUID *replica_guid, uint8_t *data, uint
    \param mapi_req pointer to the SyncImportMessageMove EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the SyncImportMessageMove EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -3115,6 +3471,16 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportMessageMove(TALLOC_CTX *mem_ctx,
 						    synccontext_object->parent_object->backend_object,
 						    source_folder_object->backend_object, mem_ctx, 1, &sourceMID, &destMID,
 						    &change_key, &predecessor_change_list, false);
+		emsmdbp_freebusy_messages_deleted(emsmdbp_ctx, source_folder_object, 1, &sourceMID);
+		emsmdbp_freebusy_folder_changed(emsmdbp_ctx, synccontext_object->parent_object);
+		emsmdbp_search_message_removed(emsmdbp_ctx, source_folder_object->object.folder->folderID, sourceMID);
+		emsmdbp_search_message_changed(emsmdbp_ctx, synccontext_object->parent_object->object.folder->folderID, destMID);
+		emsmdbp_content_index_messages_deleted(emsmdbp_ctx, source_folder_object, 1, &sourceMID);
+		emsmdbp_tombstones_messages_deleted(emsmdbp_ctx, source_folder_object, 1, &sourceMID);
+		emsmdbp_content_index_message_changed(emsmdbp_ctx, synccontext_object->parent_object, destMID);
+		emsmdbp_conversations_messages_copied(emsmdbp_ctx, synccontext_object->parent_object, 1, &sourceMID, &destMID, true);
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, source_folder_object);
+		emsmdbp_message_counts_folder_changed(emsmdbp_ctx, synccontext_object->parent_object);
 	}
 	else {
 		OC_DEBUG(0, "mapistore support not implemented yet - shouldn't occur\n");
@@ -3132,8 +3498,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportMessageMove(TALLOC_CTX *mem_ctx,
 	response->MessageId = 0;
 
 end:
-	*size += libmapiserver_RopSyncImportMessageMove_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -3145,7 +3509,7 @@ end:
    \param mapi_req pointer to the SyncOpenCollector EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncOpenCollector EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -3220,8 +3584,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncOpenCollector(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopSyncOpenCollector_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -3233,7 +3595,7 @@ end:
    \param mapi_req pointer to the GetLocalReplicaIds EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the GetLocalReplicaIds EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -3294,8 +3656,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetLocalReplicaIds(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopGetLocalReplicaIds_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -3347,7 +3707,7 @@ static struct MessageReadState *get_MessageReadState(TALLOC_CTX *mem_ctx, struct
    \param mapi_req pointer to the SyncImportReadStateChanges EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the SyncImportReadStateChanges EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -3468,6 +3828,8 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportReadStateChanges(TALLOC_CTX *mem_c
 			ret = emsmdbp_object_message_open(NULL, emsmdbp_ctx, folder_object, folder_object->object.folder->folderID, mid, true, &message_object, &msg);
 			if (ret == MAPISTORE_SUCCESS) {
 				mapistore_message_set_read_flag(emsmdbp_ctx->mstore_ctx, contextID, message_object->backend_object, flag);
+				emsmdbp_search_message_changed(emsmdbp_ctx, folder_object->object.folder->folderID, mid);
+				emsmdbp_message_counts_message_changed(emsmdbp_ctx, message_object);
 
 				/* Store the mid in the involved fmids
 				 * of the upload operations */
@@ -3486,8 +3848,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncImportReadStateChanges(TALLOC_CTX *mem_c
 	}
 
 end:
-	*size += libmapiserver_RopSyncImportReadStateChanges_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -3663,9 +4023,7 @@ static enum MAPISTATUS oxcfxics_ndr_push_transfer_state(struct ndr_push *ndr, co
 	OPENCHANGE_RETVAL_IF(!synccontext->properties.aulPropTag, MAPI_E_NOT_ENOUGH_MEMORY, mem_ctx);
 	synccontext->properties.aulPropTag[1] = PidTagChangeNumber;
 	sync_data->ndr = ndr;
-	sync_data->cutmarks_ndr = ndr_push_init_ctx(sync_data);
-	ndr_set_flags(&sync_data->cutmarks_ndr->flags, LIBNDR_FLAG_NOALIGN);
-	sync_data->cutmarks_ndr->offset = 0;
+	sync_data->segments = oxcfxics_stream_segments_init(sync_data);
 	sync_data->cnset_seen = RAWIDSET_make(sync_data, false, true);
 	sync_data->cnset_seen_fai = RAWIDSET_make(sync_data, false, true);
 	sync_data->eid_set = RAWIDSET_make(sync_data, false, false);
@@ -3765,7 +4123,7 @@ static enum MAPISTATUS oxcfxics_ndr_push_transfer_state(struct ndr_push *ndr, co
    \param mapi_req pointer to the SyncGetTransferState EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SyncGetTransferState EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -3831,26 +4189,12 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSyncGetTransferState(TALLOC_CTX *mem_ctx,
 	handles[mapi_repl->handle_idx] = ftcontext_handle->handle;
 
 	ftcontext = ftcontext_object->object.ftcontext;
-	(void) talloc_reference(ftcontext, ndr->data);
-	ftcontext->stream.buffer.data = ndr->data;
+	ftcontext->stream.buffer.data = talloc_steal(ftcontext, ndr->data);
 	ftcontext->stream.buffer.length = ndr->offset;
 
 	talloc_free(ndr);
 
-	/* cutmarks */
-	ndr = ndr_push_init_ctx(ftcontext);
-	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
-	ndr->offset = 0;
-	ndr_push_uint32(ndr, NDR_SCALARS, 0);
-	ndr_push_uint32(ndr, NDR_SCALARS, 0xffffffff);
-
-	ftcontext->cutmarks = (uint32_t *) ndr->data;
-	(void) talloc_reference(ftcontext, ndr->data);
-	talloc_free(ndr);
-
 end:
-	*size += libmapiserver_RopSyncGetTransferState_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -3862,7 +4206,7 @@ end:
    \param mapi_req pointer to the SetLocalReplicaMidsetDeleted EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the SetLocalReplicaMidsetDeleted EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -3887,8 +4231,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetLocalReplicaMidsetDeleted(TALLOC_CTX *mem
 
 	/* TODO effective work here */
 
-	*size += libmapiserver_RopSetLocalReplicaMidsetDeleted_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
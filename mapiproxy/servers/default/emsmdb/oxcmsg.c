@@ -34,37 +34,31 @@
 
 static void oxcmsg_fill_RecipientRow(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct RecipientRow *row, struct mapistore_message_recipient *recipient, struct SPropTagArray *properties)
 {
-	struct ldb_result	*res = NULL;
-	const char * const	recipient_attrs[] = { "*", NULL };
-	int			ret;
-	int			idx;
-	char			*full_name, *email_address, *simple_name, *legacyExchangeDN;
+	struct emsmdbp_recipient	*resolved;
+	int				idx;
+	char				*full_name, *email_address, *simple_name, *legacyExchangeDN;
 
 	if (!recipient->username) {
 		goto smtp_recipient;
 	}
 
-	ret = ldb_search(emsmdbp_ctx->samdb_ctx, emsmdbp_ctx, &res,
-			 ldb_get_default_basedn(emsmdbp_ctx->samdb_ctx),
-			 LDB_SCOPE_SUBTREE, recipient_attrs,
-			 "(&(objectClass=user)(sAMAccountName=*%s*)(!(objectClass=computer)))",
-			 ldb_binary_encode_string(mem_ctx, recipient->username));
 	/* If the search failed, build an external recipient: very basic for the moment */
-	if (ret != LDB_SUCCESS || !res->count) {
+	if (emsmdbp_recipient_resolve(mem_ctx, emsmdbp_ctx, EMSMDBP_RECIPIENT_BY_NAME,
+				      recipient->username, &resolved) != MAPI_E_SUCCESS) {
 		OC_DEBUG(0, "record not found for %s\n", recipient->username);
 		goto smtp_recipient;
 	}
-	full_name = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "displayName", NULL);
+	full_name = resolved->display_name;
 	if (!full_name) {
 		OC_DEBUG(0, "record found but displayName is missing for %s\n", recipient->username);
 		goto smtp_recipient;
 	}
-	simple_name = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "mailNickname", NULL);
+	simple_name = resolved->nickname;
 	if (!simple_name) {
 		OC_DEBUG(0, "record found but mailNickname is missing for %s\n", recipient->username);
 		goto smtp_recipient;
 	}
-	legacyExchangeDN = (char *) ldb_msg_find_attr_as_string(res->msgs[0], "legacyExchangeDN", NULL);
+	legacyExchangeDN = resolved->legacyExchangeDN;
 	if (!legacyExchangeDN) {
 		OC_DEBUG(0, "record found but legacyExchangeDN is missing for %s\n", recipient->username);
 		goto smtp_recipient;
@@ -144,6 +138,49 @@ static void oxcmsg_fill_OpenRecipientRow(TALLOC_CTX *mem_ctx, struct emsmdbp_con
 	oxcmsg_fill_RecipientRow_data(mem_ctx, emsmdbp_ctx, &row->RecipientRow, properties, recipient);
 }
 
+/**
+   \details Fill the recipient rows of an OpenMessage or
+   ReloadCachedInformation reply, as long as they fit in the ROP
+   buffer. The client reads the other ones with ReadRecipients.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param msg pointer to the message data
+   \param budget number of bytes the rows may use
+   \param rowsp pointer to the returned rows
+
+   \return the number of rows filled
+ */
+static uint8_t oxcmsg_fill_OpenRecipientRows(TALLOC_CTX *mem_ctx, struct emsmdbp_context *emsmdbp_ctx, struct mapistore_message *msg, int32_t budget, struct OpenRecipientRow **rowsp)
+{
+	struct OpenRecipientRow	*rows;
+	uint32_t		count;
+	uint32_t		i;
+	int32_t			row_size;
+
+	*rowsp = NULL;
+	count = msg->recipients_count;
+	if (count > UINT8_MAX) {
+		count = UINT8_MAX;
+	}
+	if (!count) return 0;
+
+	rows = talloc_array(mem_ctx, struct OpenRecipientRow, count + 1);
+	if (!rows) return 0;
+
+	for (i = 0; i < count; i++) {
+		oxcmsg_fill_OpenRecipientRow(mem_ctx, emsmdbp_ctx, &rows[i], msg->columns, msg->recipients + i);
+		/* RecipientType, CodePageId and Reserved */
+		row_size = sizeof (uint8_t) + 2 * sizeof (uint16_t);
+		row_size += libmapiserver_RecipientRow_size(rows[i].RecipientRow);
+		if (row_size > budget) break;
+		budget -= row_size;
+	}
+
+	*rowsp = rows;
+	return i;
+}
+
 /**
    \details EcDoRpc OpenMessage (0x03) Rop. This operation opens an
    existing message in a mailbox.
@@ -155,7 +192,7 @@ static void oxcmsg_fill_OpenRecipientRow(TALLOC_CTX *mem_ctx, struct emsmdbp_con
    \param mapi_repl pointer to the OpenMessage EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -178,7 +215,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenMessage(TALLOC_CTX *mem_ctx,
 	void				*data;
 	uint64_t			folderID;
 	uint64_t			messageID = 0;
-	int				i;
+	int32_t				budget;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCMSG] OpenMessage (0x03)\n");
 
@@ -205,7 +242,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenMessage(TALLOC_CTX *mem_ctx,
 	context_object = (struct emsmdbp_object *)data;
 	if (!context_object) {
 		mapi_repl->error_code = MAPI_E_NOT_FOUND;
-		*size += libmapiserver_RopOpenMessage_size(NULL);
 		return MAPI_E_SUCCESS;
 	}
 
@@ -248,9 +284,22 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenMessage(TALLOC_CTX *mem_ctx,
 		goto end;
 	}
 
+	/* Messages of another mailbox require read access to their folder */
+	retval = emsmdbp_acl_check(emsmdbp_ctx, object->parent_object, RightsReadItems);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_handles_delete(emsmdbp_ctx->handles_ctx, object_handle->handle);
+		mapi_repl->error_code = retval;
+		goto end;
+	}
+
 	handles[mapi_repl->handle_idx] = object_handle->handle;
 	retval = mapi_handles_set_private_data(object_handle, object);
 
+	/* Read the properties clients ask for next along with the message */
+	if (lpcfg_parm_bool(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "open_message_prefetch", false)) {
+		emsmdbp_object_message_prefetch(emsmdbp_ctx, object);
+	}
+
 	/* Build the OpenMessage reply */
 	response->HasNamedProperties = true;
 
@@ -276,23 +325,11 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenMessage(TALLOC_CTX *mem_ctx,
 		response->RecipientColumns.cValues = 0;
 	}
 	response->RecipientCount = msg->recipients_count;
-	response->RowCount = msg->recipients_count;
-	if (msg->recipients_count > 0) {
-		response->RecipientRows = talloc_array(mem_ctx,
-						       struct OpenRecipientRow,
-						       msg->recipients_count + 1);
-		for (i = 0; i < msg->recipients_count; i++) {
-			oxcmsg_fill_OpenRecipientRow(mem_ctx, emsmdbp_ctx, &(response->RecipientRows[i]), msg->columns, msg->recipients + i);
-		}
-	}
-	else {
-		response->RecipientCount = 0;
-	}
-	response->RowCount = response->RecipientCount;
+	response->RowCount = 0;
+	budget = EMSMDB_ROP_BUFFER_SIZE - *size - libmapiserver_RopOpenMessage_size(mapi_repl);
+	response->RowCount = oxcmsg_fill_OpenRecipientRows(mem_ctx, emsmdbp_ctx, msg, budget, &response->RecipientRows);
 
 end:
-	*size += libmapiserver_RopOpenMessage_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -308,7 +345,7 @@ end:
    \param mapi_repl pointer to the CreateMessage EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -414,6 +451,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateMessage(TALLOC_CTX *mem_ctx,
 			}
 			goto end;
 		}
+		emsmdbp_message_counts_track(emsmdbp_ctx, message_object, true);
 		break;
 	case false:
 		retval = openchangedb_message_create(emsmdbp_ctx->mstore_ctx, 
@@ -510,8 +548,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateMessage(TALLOC_CTX *mem_ctx,
 
 end:
 
-	*size += libmapiserver_RopCreateMessage_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -528,7 +564,7 @@ end:
    EcDoRpc_MAPI_REPL structure
 
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -588,13 +624,23 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSaveChangesMessage(TALLOC_CTX *mem_ctx,
 	case true:
                 contextID = emsmdbp_get_contextID(object);
 		messageID = object->object.message->messageID;
-		ret = mapistore_message_save(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, mem_ctx);
+		ret = emsmdbp_object_message_flush_properties(emsmdbp_ctx, object);
+		if (ret == MAPISTORE_SUCCESS) {
+			ret = mapistore_message_save(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, mem_ctx);
+		}
 		if (ret == MAPISTORE_ERR_DENIED) {
 			mapi_repl->error_code = MAPI_E_NO_ACCESS;
 			goto end;
 		}
 		owner = emsmdbp_get_owner(object);
 		mapistore_indexing_record_add_mid(emsmdbp_ctx->mstore_ctx, contextID, owner, messageID);
+		if (ret == MAPISTORE_SUCCESS) {
+			emsmdbp_freebusy_message_saved(object);
+			emsmdbp_search_message_saved(emsmdbp_ctx, object);
+			emsmdbp_content_index_message_saved(emsmdbp_ctx, object);
+			emsmdbp_conversations_message_saved(emsmdbp_ctx, object);
+			emsmdbp_message_counts_message_changed(emsmdbp_ctx, object);
+		}
 		break;
 	}
 
@@ -602,8 +648,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSaveChangesMessage(TALLOC_CTX *mem_ctx,
 	mapi_repl->u.mapi_SaveChangesMessage.MessageId = object->object.message->messageID;
 
 end:
-	*size += libmapiserver_RopSaveChangesMessage_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -618,7 +662,7 @@ end:
    \param mapi_repl pointer to the RemoveAllRecipients EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -676,8 +720,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopRemoveAllRecipients(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopRemoveAllRecipients_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -699,11 +741,9 @@ static enum MAPISTATUS oxcmsg_resolve_partial_x500name(TALLOC_CTX *mem_ctx,
 						       uint8_t prefix_size, const char *x500name,
 						       char **username_p)
 {
-	char			*x500dn;
-	char			*username;
-	const char * const	attrs[] = { "sAMAccountName", NULL };
-	int			ret;
-	struct ldb_result	*res = NULL;
+	char				*x500dn;
+	char				*username;
+	struct emsmdbp_recipient	*resolved;
 
 	OPENCHANGE_RETVAL_IF(!username_p, MAPI_E_INVALID_PARAMETER, NULL);
 
@@ -729,14 +769,11 @@ static enum MAPISTATUS oxcmsg_resolve_partial_x500name(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Step 1. Try to find out an account with x500dn we have */
-	ret = ldb_search(emsmdbp_ctx->samdb_ctx, mem_ctx, &res,
-			 ldb_get_default_basedn(emsmdbp_ctx->samdb_ctx), LDB_SCOPE_SUBTREE,
-			 attrs, "legacyExchangeDN=%s", x500dn);
-	if (ret != LDB_SUCCESS || res->count != 1) {
+	if (emsmdbp_recipient_resolve(mem_ctx, emsmdbp_ctx, EMSMDBP_RECIPIENT_BY_X500, x500dn, &resolved) != MAPI_E_SUCCESS) {
 		/* no such user, just pass what we have */
 		username = x500dn;
 	} else {
-		username = discard_const_p(char, ldb_msg_find_attr_as_string(res->msgs[0], "sAMAccountName", x500dn));
+		username = resolved->account ? resolved->account : x500dn;
 	}
 
 	*username_p = username;
@@ -848,7 +885,7 @@ static enum MAPISTATUS oxcmsg_parse_ModifyRecipientRow(TALLOC_CTX *mem_ctx, stru
    \param mapi_repl pointer to the ModifyRecipients EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -928,8 +965,116 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopModifyRecipients(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopModifyRecipients_size(mapi_repl);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc ReadRecipients (0xf) Rop. This operation reads the
+   recipients of a message from a given row, the ones OpenMessage
+   could not fit in its reply.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the ReadRecipients EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the ReadRecipients EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopReadRecipients(TALLOC_CTX *mem_ctx,
+						   struct emsmdbp_context *emsmdbp_ctx,
+						   struct EcDoRpc_MAPI_REQ *mapi_req,
+						   struct EcDoRpc_MAPI_REPL *mapi_repl,
+						   uint32_t *handles, uint16_t *size)
+{
+	enum MAPISTATUS			retval;
+	struct ReadRecipients_req	*request;
+	struct ReadRecipients_repl	*response;
+	struct mapi_handles		*rec = NULL;
+	void				*private_data;
+	struct mapistore_message	*msg;
+	struct mapistore_message_recipient	*recipient;
+	struct ReadRecipientRow		*row;
+	struct emsmdbp_object		*object;
+	uint32_t			contextID;
+	uint32_t			count;
+	uint32_t			i;
+	int32_t				budget;
+	int32_t				row_size;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCMSG] ReadRecipients (0xf)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	request = &mapi_req->u.mapi_ReadRecipients;
+	response = &mapi_repl->u.mapi_ReadRecipients;
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	response->RowCount = 0;
+
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handles[mapi_req->handle_idx], &rec);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_NOT_FOUND;
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(rec, &private_data);
+	object = (struct emsmdbp_object *)private_data;
+	if (!object || object->type != EMSMDBP_OBJECT_MESSAGE || !emsmdbp_is_mapistore(object)) {
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		goto end;
+	}
+
+	contextID = emsmdbp_get_contextID(object);
+	if (mapistore_message_get_message_data(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, mem_ctx, &msg) != MAPISTORE_SUCCESS) {
+		mapi_repl->error_code = MAPI_E_NOT_FOUND;
+		goto end;
+	}
+	if (request->RowId >= msg->recipients_count) {
+		mapi_repl->error_code = MAPI_E_NOT_FOUND;
+		goto end;
+	}
 
+	count = msg->recipients_count - request->RowId;
+	if (count > UINT8_MAX) {
+		count = UINT8_MAX;
+	}
+	response->RecipientRows = talloc_array(mem_ctx, struct ReadRecipientRow, count + 1);
+	if (!response->RecipientRows) {
+		mapi_repl->error_code = MAPI_E_NOT_ENOUGH_MEMORY;
+		goto end;
+	}
+
+	/* As many rows as the ROP buffer holds, at least one */
+	budget = EMSMDB_ROP_BUFFER_SIZE - *size - libmapiserver_RopReadRecipients_size(mapi_repl);
+	for (i = 0; i < count; i++) {
+		row = &response->RecipientRows[i];
+		recipient = msg->recipients + request->RowId + i;
+		row->RowId = request->RowId + i;
+		row->RecipClass = recipient->type;
+		row->CodePageId = CP_USASCII;
+		row->ulReserved = 0;
+		oxcmsg_fill_RecipientRow(mem_ctx, emsmdbp_ctx, &row->RecipientRow, recipient, msg->columns);
+		oxcmsg_fill_RecipientRow_data(mem_ctx, emsmdbp_ctx, &row->RecipientRow, msg->columns, recipient);
+
+		row_size = SIZE_DFLT_READRECIPIENTROW + libmapiserver_RecipientRow_size(row->RecipientRow);
+		if (i && row_size > budget) break;
+		budget -= row_size;
+	}
+	response->RowCount = i;
+
+end:
 	return MAPI_E_SUCCESS;
 }
 
@@ -945,7 +1090,7 @@ end:
    \param mapi_repl pointer to the ReloadCachedInformation
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -963,7 +1108,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopReloadCachedInformation(TALLOC_CTX *mem_ctx,
 	struct mapistore_message	*msg;
 	struct emsmdbp_object		*object;
 	uint32_t			contextID;
-	int				i;
+	int32_t				budget;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCMSG] ReloadCachedInformation (0x10)\n");
 
@@ -1028,21 +1173,15 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopReloadCachedInformation(TALLOC_CTX *mem_ctx,
 			mapi_repl->u.mapi_ReloadCachedInformation.RecipientColumns.cValues = 0;
 		}
 		mapi_repl->u.mapi_ReloadCachedInformation.RecipientCount = msg->recipients_count;
-		mapi_repl->u.mapi_ReloadCachedInformation.RowCount = msg->recipients_count;
-		if (msg->recipients_count > 0) {
-			mapi_repl->u.mapi_ReloadCachedInformation.RecipientRows = talloc_array(mem_ctx, 
-											       struct OpenRecipientRow, 
-											       msg->recipients_count + 1);
-			for (i = 0; i < msg->recipients_count; i++) {
-				oxcmsg_fill_OpenRecipientRow(mem_ctx, emsmdbp_ctx, &(mapi_repl->u.mapi_ReloadCachedInformation.RecipientRows[i]), msg->columns, msg->recipients + i);
-			}
-		}
+		mapi_repl->u.mapi_ReloadCachedInformation.RowCount = 0;
+		budget = EMSMDB_ROP_BUFFER_SIZE - *size - libmapiserver_RopReloadCachedInformation_size(mapi_repl);
+		mapi_repl->u.mapi_ReloadCachedInformation.RowCount =
+			oxcmsg_fill_OpenRecipientRows(mem_ctx, emsmdbp_ctx, msg, budget,
+						      &mapi_repl->u.mapi_ReloadCachedInformation.RecipientRows);
 		break;
 	}
 
 end:
-	*size += libmapiserver_RopReloadCachedInformation_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1059,7 +1198,7 @@ end:
    EcDoRpc_MAPI_REPL structure
 
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1122,7 +1261,10 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetMessageReadFlag(TALLOC_CTX *mem_ctx,
 		break;
 	case true:
                 contextID = emsmdbp_get_contextID(message_object);
+		emsmdbp_message_counts_track(emsmdbp_ctx, message_object, false);
 		mapistore_message_set_read_flag(emsmdbp_ctx->mstore_ctx, contextID, message_object->backend_object, request->flags);
+		emsmdbp_search_message_saved(emsmdbp_ctx, message_object);
+		emsmdbp_message_counts_message_changed(emsmdbp_ctx, message_object);
 		break;
 	}
 
@@ -1130,8 +1272,99 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetMessageReadFlag(TALLOC_CTX *mem_ctx,
 	mapi_repl->u.mapi_SetMessageReadFlag.ReadStatusChanged = false;
 
 end:
-	*size += libmapiserver_RopSetMessageReadFlag_size(mapi_repl);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc SetReadFlags (0x66) Rop. This operation changes the
+   read flag of a set of messages of a folder.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the SetReadFlags EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the SetReadFlags EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
 
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetReadFlags(TALLOC_CTX *mem_ctx,
+						 struct emsmdbp_context *emsmdbp_ctx,
+						 struct EcDoRpc_MAPI_REQ *mapi_req,
+						 struct EcDoRpc_MAPI_REPL *mapi_repl,
+						 uint32_t *handles, uint16_t *size)
+{
+	struct SetReadFlags_req		*request;
+	enum MAPISTATUS			retval;
+	enum mapistore_error		ret;
+	uint32_t			handle;
+	struct mapi_handles		*rec = NULL;
+	struct emsmdbp_object		*folder_object = NULL;
+	uint32_t			contextID;
+	void				*data;
+	uint16_t			i;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCMSG] SetReadFlags (0x66)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	request = &mapi_req->u.mapi_SetReadFlags;
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->u.mapi_SetReadFlags.PartialCompletion = false;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &rec);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(rec, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+
+	folder_object = (struct emsmdbp_object *) data;
+	if (!folder_object || folder_object->type != EMSMDBP_OBJECT_FOLDER) {
+		OC_DEBUG(5, "  no object or object is not a folder\n");
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		goto end;
+	}
+
+	if (!emsmdbp_is_mapistore(folder_object)) {
+		OC_DEBUG(0, "Not implemented yet\n");
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		goto end;
+	}
+
+	contextID = emsmdbp_get_contextID(folder_object);
+	ret = mapistore_folder_set_read_flags(emsmdbp_ctx->mstore_ctx, contextID, folder_object->backend_object,
+					      request->MessageIdCount, request->MessageIds, request->ReadFlags);
+	if (ret != MAPISTORE_SUCCESS) {
+		OC_DEBUG(5, "  unable to change the read flags: %s\n", mapistore_errstr(ret));
+		mapi_repl->u.mapi_SetReadFlags.PartialCompletion = true;
+	}
+
+	for (i = 0; i < request->MessageIdCount; i++) {
+		emsmdbp_search_message_changed(emsmdbp_ctx, folder_object->object.folder->folderID, request->MessageIds[i]);
+	}
+	emsmdbp_message_counts_folder_changed(emsmdbp_ctx, folder_object);
+
+end:
 	return MAPI_E_SUCCESS;
 }
 
@@ -1147,7 +1380,7 @@ end:
    \param mapi_repl pointer to the GetMessageStatus EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \todo Replace Stub implementation with mapistore calls
 
@@ -1212,7 +1445,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetMessageStatus(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopGetMessageStatus_size(mapi_repl);
 	return MAPI_E_SUCCESS;
 }
 
@@ -1228,7 +1460,7 @@ end:
    \param mapi_repl pointer to the GetAttachmentTable
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1293,8 +1525,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetAttachmentTable(TALLOC_CTX *mem_ctx,
 	mapi_handles_set_private_data(table_rec, table_object);
 	
  end:
-	*size += libmapiserver_RopGetAttachmentTable_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;	
 }
 
@@ -1309,7 +1539,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetAttachmentTable(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the OpenAttach
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1392,8 +1622,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenAttach(TALLOC_CTX *mem_ctx,
         }
 
  end:
-	*size += libmapiserver_RopOpenAttach_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;	
 }
 
@@ -1408,7 +1636,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenAttach(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the CreateAttach
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1500,8 +1728,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateAttach(TALLOC_CTX *mem_ctx,
         }
 
  end:
-	*size += libmapiserver_RopCreateAttach_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;	
 }
 
@@ -1516,7 +1742,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateAttach(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the SaveChangesAttachment
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1539,8 +1765,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSaveChangesAttachment(TALLOC_CTX *mem_ctx,
 	mapi_repl->error_code = MAPI_E_SUCCESS;
 	mapi_repl->handle_idx = mapi_req->u.mapi_SaveChangesAttachment.handle_idx;
 
-	*size += libmapiserver_RopSaveChangesAttachment_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;	
 }
 
@@ -1555,7 +1779,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSaveChangesAttachment(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the OpenEmbeddedMessage
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1579,7 +1803,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenEmbeddedMessage(TALLOC_CTX *mem_ctx,
 	struct emsmdbp_object           *attachment_object = NULL;
 	struct emsmdbp_object           *message_object = NULL;
         bool                            mapistore;
-	int				i;
+	int32_t				budget;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCMSG] OpenEmbeddedMessage (0x46)\n");
 
@@ -1669,13 +1893,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenEmbeddedMessage(TALLOC_CTX *mem_ctx,
 		}
 
 		response->RecipientCount = msg->recipients_count;
-		response->RowCount = msg->recipients_count;
-		if (msg->recipients_count > 0) {
-                        response->RecipientRows = talloc_array(mem_ctx, struct OpenRecipientRow, msg->recipients_count + 1);
-			for (i = 0; i < msg->recipients_count; i++) {
-				oxcmsg_fill_OpenRecipientRow(mem_ctx, emsmdbp_ctx, &(response->RecipientRows[i]), msg->columns, msg->recipients + i);
-			}
-                }
+		response->RowCount = 0;
+		budget = EMSMDB_ROP_BUFFER_SIZE - *size - libmapiserver_RopOpenEmbeddedMessage_size(mapi_repl);
+		response->RowCount = oxcmsg_fill_OpenRecipientRows(mem_ctx, emsmdbp_ctx, msg, budget, &response->RecipientRows);
 
                 /* Initialize Message object */
                 handle = handles[mapi_req->handle_idx];
@@ -1694,7 +1914,5 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenEmbeddedMessage(TALLOC_CTX *mem_ctx,
 	}
 
  end:
-	*size += libmapiserver_RopOpenEmbeddedMessage_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;	
 }
@@ -44,7 +44,7 @@
    \param mapi_repl pointer to the RegisterNotification
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -132,7 +132,5 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopRegisterNotification(TALLOC_CTX *mem_ctx,
 	subscription_object->object.subscription->handle = subscription_rec->handle;
 
 end:
-	*size += libmapiserver_RopRegisterNotification_size();
-
 	return MAPI_E_SUCCESS;
 }
@@ -42,7 +42,7 @@
    \param mapi_repl pointer to the GetPermissionsTable
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -115,8 +115,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPermissionsTable(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopGetPermissionsTable_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -129,7 +127,7 @@ end:
    \param mapi_req pointer to the GetPerUserLongTermIds EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetPerUserLongTermIds EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -194,13 +192,14 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopModifyPermissions(TALLOC_CTX *mem_ctx,
 			OC_DEBUG(5, "mapistore_folder_modify_permissions: %s\n", mapistore_errstr(mretval));
 			mapi_repl->error_code = mapistore_error_to_mapi(mretval);
 		}
+		else {
+			emsmdbp_acl_cache_invalidate(emsmdbp_ctx, emsmdbp_get_owner(folder_object));
+		}
 	}
 	else {
 		mapi_repl->error_code = MAPI_E_NOT_FOUND;
 	}
 
 end:
-	*size += libmapiserver_RopModifyPermissions_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
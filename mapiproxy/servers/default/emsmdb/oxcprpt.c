@@ -46,7 +46,7 @@
    \param mapi_repl pointer to the GetPropertiesSpecific
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -61,14 +61,13 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertiesSpecific(TALLOC_CTX *mem_ctx,
 	struct GetProps_req	*request;
 	struct GetProps_repl	*response;
 	uint32_t		handle;
-	uint16_t		property_id, property_type;
 	struct mapi_handles	*rec = NULL;
 	void			*private_data = NULL;
 	struct emsmdbp_object	*object;
+	struct emsmdbp_propset	*propset;
         struct SPropTagArray    *properties;
         void                    **data_pointers;
         enum MAPISTATUS         *retvals = NULL;
-        bool                    *untyped_status;
         uint16_t                i, propType;
 	uint32_t		stream_size;
 	struct emsmdbp_stream_data *stream_data;
@@ -122,46 +121,25 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertiesSpecific(TALLOC_CTX *mem_ctx,
         local_mem_ctx = talloc_new(NULL);
         OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
 
-        properties = talloc_zero(local_mem_ctx, struct SPropTagArray);
-        properties->cValues = request->prop_count;
-        properties->aulPropTag = talloc_array(properties, enum MAPITAGS, request->prop_count);
-        untyped_status = talloc_array(local_mem_ctx, bool, request->prop_count);
-
-        for (i = 0; i < request->prop_count; i++) {
-                properties->aulPropTag[i] = request->properties[i];
-                if ((request->properties[i] & 0xffff) == 0) {
-			property_id = request->properties[i] >> 16;
-			if (property_id < 0x8000) {
-				property_type = get_property_type(property_id);
-			}
-			else {
-				property_type = 0;
-				mapistore_namedprops_get_nameid_type(emsmdbp_ctx->mstore_ctx->nprops_ctx, property_id, &property_type);
-			}
-			if (property_type) {
-				properties->aulPropTag[i] |= property_type;
-				untyped_status[i] = true;
-			}
-			else {
-				properties->aulPropTag[i] |= PT_ERROR; /* fail with a MAPI_E_NOT_FOUND */
-				untyped_status[i] = false;
-			}
-                }
-                else {
-                        untyped_status[i] = false;
-                }
-        }
+	/* The tags are typed once per session, see emsmdbp_propset.c */
+	propset = emsmdbp_propset_get(local_mem_ctx, emsmdbp_ctx, request->prop_count, request->properties);
+	properties = emsmdbp_propset_copy_tags(local_mem_ctx, propset);
+	if (!properties) {
+		mapi_repl->error_code = MAPI_E_NOT_ENOUGH_MEMORY;
+		talloc_free(local_mem_ctx);
+		goto end;
+	}
 
         data_pointers = emsmdbp_object_get_properties(local_mem_ctx, emsmdbp_ctx, object, properties, &retvals);
         if (data_pointers) {
-		for (i = 0; i < request->prop_count; i++) {
+		for (i = 0; propset->may_stream && i < request->prop_count; i++) {
 			if (retvals[i] == MAPI_E_SUCCESS) {
 				propType = properties->aulPropTag[i] & 0xffff;
 				if (propType == PT_STRING8) {
 					stream_size = strlen((const char *) data_pointers[i]) + 1;
 				}
 				else if (propType == PT_UNICODE) {
-					stream_size = strlen_m_ext((char *) data_pointers[i], CH_UTF8, CH_UTF16LE) * 2 + 2;
+					stream_size = mapi_utf16_size((const char *) data_pointers[i]);
 				}
 				else if (propType == PT_BINARY) {
 					stream_size = ((struct Binary_r *) data_pointers[i])->cb;
@@ -188,13 +166,11 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertiesSpecific(TALLOC_CTX *mem_ctx,
 				      properties,
 				      data_pointers,
 				      retvals,
-				      untyped_status);
+				      propset->untyped_status);
 	}
 	talloc_free(local_mem_ctx);
 
  end:
-	*size += libmapiserver_RopGetPropertiesSpecific_size(mapi_req, mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -209,7 +185,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertiesSpecific(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the GetPropertiesAll EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -291,7 +267,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertiesAll(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopGetPropertiesAll_size(mapi_repl);
 	return MAPI_E_SUCCESS;
 }
 
@@ -307,7 +282,7 @@ end:
    \param mapi_repl pointer to the SetProperties EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -372,7 +347,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertiesList(TALLOC_CTX *mem_ctx,
 	response->tags = SPropTagArray->aulPropTag;
 
 end:
-	*size += libmapiserver_RopGetPropertiesList_size(mapi_repl);
 	return MAPI_E_SUCCESS;
 }
 
@@ -387,7 +361,7 @@ end:
    \param mapi_repl pointer to the SetProperties EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -455,8 +429,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetProperties(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopSetProperties_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -472,7 +444,7 @@ end:
    \param mapi_repl pointer to the DeleteProperties EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -498,8 +470,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteProperties(TALLOC_CTX *mem_ctx,
 	mapi_repl->u.mapi_DeleteProps.PropertyProblemCount = 0;
 	mapi_repl->u.mapi_DeleteProps.PropertyProblem = NULL;
 
-	*size += libmapiserver_RopDeleteProperties_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -515,7 +485,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeleteProperties(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the OpenStream EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -532,12 +502,15 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenStream(TALLOC_CTX *mem_ctx,
 	struct emsmdbp_object		*parent_object = NULL;
 	struct OpenStream_req		*request;
 	uint32_t			handle;
+	uint32_t			spill_size;
 	void				*data;
         struct SPropTagArray		properties;
 	void				**data_pointers;
 	enum MAPISTATUS			*retvals;
 	struct emsmdbp_stream_data	*stream_data;
 	enum OpenStream_OpenModeFlags	mode;
+	enum mapistore_stream_mode	stream_mode;
+	enum mapistore_error		mretval;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCPRPT] OpenStream (0x2b)\n");
 
@@ -614,8 +587,45 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenStream(TALLOC_CTX *mem_ctx,
 	object->object.stream->property = request->PropertyTag;
 	object->object.stream->stream.position = 0;
 	object->object.stream->stream.buffer.length = 0;
+	object->object.stream->stream.spill_size = lpcfg_parm_int(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "stream_spill_size", 0) * 1024;
+	object->object.stream->stream.spill_dir = lpcfg_parm_string(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "stream_spill_dir");
+	/* Sessions short on memory move their streams to disk early */
+	spill_size = emsmdbp_memory_buffer_size(emsmdbp_ctx, UINT32_MAX);
+	if (spill_size != UINT32_MAX && (!object->object.stream->stream.spill_size ||
+					 object->object.stream->stream.spill_size > spill_size)) {
+		object->object.stream->stream.spill_size = spill_size;
+	}
+
+	/* Let the backend serve the property in chunks when it can,
+	   unless it was already fetched by GetProps */
+	if (emsmdbp_is_mapistore(parent_object) && !emsmdbp_object_get_stream_data(parent_object, request->PropertyTag)) {
+		if (mode == OpenStream_ReadOnly) {
+			stream_mode = MAPISTORE_STREAM_READ;
+		}
+		else if (mode == OpenStream_ReadWrite) {
+			stream_mode = MAPISTORE_STREAM_READWRITE;
+		}
+		else {
+			stream_mode = MAPISTORE_STREAM_CREATE;
+		}
+		mretval = mapistore_properties_open_property_stream(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(parent_object),
+								    parent_object->backend_object, object, request->PropertyTag,
+								    stream_mode, &object->object.stream->backend_stream,
+								    &object->object.stream->backend_size);
+		if (mretval != MAPISTORE_SUCCESS && mretval != MAPISTORE_ERR_NOT_IMPLEMENTED) {
+			mapi_repl->error_code = mapistore_error_to_mapi(mretval);
+			talloc_free(object);
+			goto end;
+		}
+		if (mretval == MAPISTORE_ERR_NOT_IMPLEMENTED) {
+			object->object.stream->backend_stream = NULL;
+		}
+	}
 
-	if (mode == OpenStream_ReadOnly || mode == OpenStream_ReadWrite) {
+	if (object->object.stream->backend_stream) {
+		object->object.stream->read_write = (mode != OpenStream_ReadOnly);
+	}
+	else if (mode == OpenStream_ReadOnly || mode == OpenStream_ReadWrite) {
 		object->object.stream->read_write = (mode == OpenStream_ReadWrite);
 		stream_data = emsmdbp_object_get_stream_data(parent_object, object->object.stream->property);
 		if (stream_data) {
@@ -635,9 +645,8 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenStream(TALLOC_CTX *mem_ctx,
 				goto end;
 			}
 			if (retvals[0] == MAPI_E_SUCCESS) {
-				stream_data = emsmdbp_stream_data_from_value(data_pointers, request->PropertyTag, data_pointers[0], object->object.stream->read_write);
+				stream_data = emsmdbp_stream_data_from_value(object, request->PropertyTag, data_pointers[0], object->object.stream->read_write);
 				object->object.stream->stream.buffer = stream_data->data;
-				(void) talloc_reference(object, stream_data);
 				talloc_free(data_pointers);
 				talloc_free(retvals);
 			}
@@ -656,7 +665,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenStream(TALLOC_CTX *mem_ctx,
 		object->object.stream->stream.buffer.length = 0;
 	}
 
-	mapi_repl->u.mapi_OpenStream.StreamSize = object->object.stream->stream.buffer.length;
+	mapi_repl->u.mapi_OpenStream.StreamSize = emsmdbp_object_stream_get_size(object->object.stream);
 
 	retval = mapi_handles_add(emsmdbp_ctx->handles_ctx, handle, &rec);
 	(void) talloc_reference(rec, object);
@@ -665,8 +674,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOpenStream(TALLOC_CTX *mem_ctx,
 	talloc_free(object);
 
 end:
-	*size += libmapiserver_RopOpenStream_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -682,7 +689,7 @@ end:
    \param mapi_repl pointer to the ReadStream EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -696,7 +703,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopReadStream(TALLOC_CTX *mem_ctx,
 	struct mapi_handles		*rec = NULL;
 	void				*private_data;
 	struct emsmdbp_object		*object;
+	struct emsmdbp_object_stream	*stream;
 	uint32_t			handle, buffer_size;
+	enum mapistore_error		mretval;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCPRPT] ReadStream (0x2c)\n");
 
@@ -742,12 +751,25 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopReadStream(TALLOC_CTX *mem_ctx,
 			buffer_size = mapi_req->u.mapi_ReadStream.MaximumByteCount.value;
 		}
 	}
-
-        mapi_repl->u.mapi_ReadStream.data = emsmdbp_stream_read_buffer(&object->object.stream->stream, buffer_size);
+	buffer_size = emsmdbp_memory_buffer_size(emsmdbp_ctx, buffer_size);
+
+	stream = object->object.stream;
+	if (stream->backend_stream) {
+		mretval = mapistore_stream_read(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object), stream->backend_stream,
+						mem_ctx, stream->stream.position, buffer_size, &mapi_repl->u.mapi_ReadStream.data);
+		if (mretval != MAPISTORE_SUCCESS) {
+			mapi_repl->error_code = mapistore_error_to_mapi(mretval);
+			mapi_repl->u.mapi_ReadStream.data.length = 0;
+			mapi_repl->u.mapi_ReadStream.data.data = NULL;
+			goto end;
+		}
+		stream->stream.position += mapi_repl->u.mapi_ReadStream.data.length;
+	}
+	else {
+		mapi_repl->u.mapi_ReadStream.data = emsmdbp_stream_read_buffer(&stream->stream, buffer_size);
+	}
 
 end:
-	*size += libmapiserver_RopReadStream_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -763,7 +785,7 @@ end:
    \param mapi_repl pointer to the WriteStream EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -777,8 +799,10 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopWriteStream(TALLOC_CTX *mem_ctx,
 	struct mapi_handles		*parent = NULL;
 	void				*private_data;
 	struct emsmdbp_object		*object;
+	struct emsmdbp_object_stream	*stream;
 	uint32_t			handle;
 	struct WriteStream_req		*request;
+	enum mapistore_error		mretval;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCPRPT] WriteStream (0x2d)\n");
 
@@ -817,15 +841,27 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopWriteStream(TALLOC_CTX *mem_ctx,
 	}
 
 	request = &mapi_req->u.mapi_WriteStream;
-	if (request->data.length > 0) {
-                emsmdbp_stream_write_buffer(object->object.stream, &object->object.stream->stream, request->data);
+	stream = object->object.stream;
+	if (request->data.length > 0 && stream->backend_stream) {
+		mretval = mapistore_stream_write(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object), stream->backend_stream,
+						 stream->stream.position, request->data);
+		if (mretval != MAPISTORE_SUCCESS) {
+			mapi_repl->error_code = mapistore_error_to_mapi(mretval);
+			goto end;
+		}
+		stream->stream.position += request->data.length;
+		if (stream->stream.position > stream->backend_size) {
+			stream->backend_size = stream->stream.position;
+		}
+		mapi_repl->u.mapi_WriteStream.WrittenSize = request->data.length;
+	}
+	else if (request->data.length > 0) {
+                emsmdbp_stream_write_buffer(stream, &stream->stream, request->data);
 		mapi_repl->u.mapi_WriteStream.WrittenSize = request->data.length;
 	}
 
 	object->object.stream->needs_commit = true;
 end:
-	*size += libmapiserver_RopWriteStream_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -839,7 +875,7 @@ end:
    \param mapi_repl pointer to the DeleteProperties EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -894,8 +930,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCommitStream(TALLOC_CTX *mem_ctx,
 	emsmdbp_object_stream_commit(object);
 
 end:
-	*size += libmapiserver_RopCommitStream_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -910,7 +944,7 @@ end:
    \param mapi_repl pointer to the WriteStream EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -956,11 +990,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetStreamSize(TALLOC_CTX *mem_ctx,
 		goto end;
 	}
 
-	mapi_repl->u.mapi_GetStreamSize.StreamSize = object->object.stream->stream.buffer.length;
+	mapi_repl->u.mapi_GetStreamSize.StreamSize = emsmdbp_object_stream_get_size(object->object.stream);
 
 end:
-	*size += libmapiserver_RopGetStreamSize_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -975,7 +1007,7 @@ end:
    \param mapi_repl pointer to the WriteStream EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1029,7 +1061,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSeekStream(TALLOC_CTX *mem_ctx,
 		new_position = object->object.stream->stream.position;
 		break;
 	case 2: /* end */
-		new_position = object->object.stream->stream.buffer.length;
+		new_position = emsmdbp_object_stream_get_size(object->object.stream);
 		break;
 	default:
 		mapi_repl->error_code = MAPI_E_INVALID_PARAMETER;
@@ -1037,7 +1069,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSeekStream(TALLOC_CTX *mem_ctx,
 	}
 
 	new_position += mapi_req->u.mapi_SeekStream.Offset;
-	if (new_position < object->object.stream->stream.buffer.length + 1) {
+	if (new_position <= emsmdbp_object_stream_get_size(object->object.stream)) {
 		object->object.stream->stream.position = new_position;
 		mapi_repl->u.mapi_SeekStream.NewPosition = new_position;
 	}
@@ -1046,8 +1078,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSeekStream(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopSeekStream_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1063,7 +1093,7 @@ end:
    \param mapi_repl pointer to the DeleteProperties EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1111,8 +1141,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetStreamSize(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopSetStreamSize_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1127,7 +1155,7 @@ end:
    \param mapi_repl pointer to the GetPropertyIdsFromNames
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
 */
@@ -1138,11 +1166,16 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertyIdsFromNames(TALLOC_CTX *mem_ctx,
 							    uint32_t *handles, uint16_t *size)
 {
 	enum mapistore_error	retval;
-	int			i;
-	int			ret;
+	struct namedprops_context *nprops_ctx;
+	struct MAPINAMEID	*nameid;
+	struct MAPINAMEID	*new_nameid;
 	struct GUID		*lpguid;
-	bool			has_transaction = false;
+	uint16_t		*propID;
+	uint16_t		*new_propID;
 	uint16_t		mapped_id = 0;
+	uint32_t		count;
+	uint32_t		new_count = 0;
+	uint32_t		i, j;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCPRPT] GetPropertyIdsFromNames (0x56)\n");
 
@@ -1153,43 +1186,80 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertyIdsFromNames(TALLOC_CTX *mem_ctx,
 	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
 	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
 
+	nprops_ctx = emsmdbp_ctx->mstore_ctx->nprops_ctx;
+	count = mapi_req->u.mapi_GetIDsFromNames.count;
+	nameid = mapi_req->u.mapi_GetIDsFromNames.nameid;
+
 	mapi_repl->opnum = mapi_req->opnum;
 	mapi_repl->error_code = MAPI_E_SUCCESS;
 	mapi_repl->handle_idx = mapi_req->handle_idx;
-	mapi_repl->u.mapi_GetIDsFromNames.count = mapi_req->u.mapi_GetIDsFromNames.count;
-	mapi_repl->u.mapi_GetIDsFromNames.propID = talloc_array(mem_ctx, uint16_t, 
-								mapi_req->u.mapi_GetIDsFromNames.count);
-
-	for (i = 0; i < mapi_req->u.mapi_GetIDsFromNames.count; i++) {
-		ret = mapistore_namedprops_get_mapped_id(emsmdbp_ctx->mstore_ctx->nprops_ctx, 
-							 mapi_req->u.mapi_GetIDsFromNames.nameid[i],
-							 &mapi_repl->u.mapi_GetIDsFromNames.propID[i]);
-		if (ret == MAPISTORE_SUCCESS)
-			continue;
-		// It doesn't exist, let's create it!
-		if (mapi_req->u.mapi_GetIDsFromNames.ulFlags == GetIDsFromNames_GetOrCreate) {
-			if (!has_transaction) {
-				has_transaction = true;
-				retval = mapistore_namedprops_transaction_start(emsmdbp_ctx->mstore_ctx->nprops_ctx);
+	mapi_repl->u.mapi_GetIDsFromNames.count = count;
+	mapi_repl->u.mapi_GetIDsFromNames.propID = talloc_array(mem_ctx, uint16_t, count);
+	propID = mapi_repl->u.mapi_GetIDsFromNames.propID;
+	OPENCHANGE_RETVAL_IF(count && !propID, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	/* Outlook asks for hundreds of names at once on first logon:
+	   they are looked up, then created, in one go */
+	retval = mapistore_namedprops_get_mapped_ids(nprops_ctx, count, nameid, propID);
+	OPENCHANGE_RETVAL_IF(retval != MAPISTORE_SUCCESS, MAPI_E_UNABLE_TO_COMPLETE, NULL);
+
+	if (mapi_req->u.mapi_GetIDsFromNames.ulFlags == GetIDsFromNames_GetOrCreate) {
+		new_nameid = talloc_array(mem_ctx, struct MAPINAMEID, count);
+		new_propID = talloc_array(mem_ctx, uint16_t, count);
+		OPENCHANGE_RETVAL_IF(count && (!new_nameid || !new_propID), MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+		for (i = 0; i < count; i++) {
+			if (propID[i]) continue;
+			if (nameid[i].ulKind != MNID_ID
+			    && (nameid[i].ulKind != MNID_STRING || !nameid[i].kind.lpwstr.Name)) {
+				mapi_repl->error_code = MAPI_W_ERRORS_RETURNED;
+				continue;
+			}
+
+			/* It doesn't exist, let's create it! */
+			if (!new_count) {
+				retval = mapistore_namedprops_transaction_start(nprops_ctx);
 				if (retval != MAPISTORE_SUCCESS) {
 					return MAPI_E_UNABLE_TO_COMPLETE;
 				}
 
-				retval = mapistore_namedprops_next_unused_id(emsmdbp_ctx->mstore_ctx->nprops_ctx, &mapped_id);
+				retval = mapistore_namedprops_next_unused_id(nprops_ctx, &mapped_id);
 				if (retval != MAPISTORE_SUCCESS) {
 					OC_DEBUG(0, "ERROR: No remaining namedprops ID available\n");
 					abort();
 				}
-			} else {
-				mapped_id++;
 			}
-			mapistore_namedprops_create_id(emsmdbp_ctx->mstore_ctx->nprops_ctx,
-						       mapi_req->u.mapi_GetIDsFromNames.nameid[i],
-						       mapped_id);
-			mapi_repl->u.mapi_GetIDsFromNames.propID[i] = mapped_id;
-		} else {
-			mapi_repl->u.mapi_GetIDsFromNames.propID[i] = 0x0000;
-			lpguid = &mapi_req->u.mapi_GetIDsFromNames.nameid[i].lpguid;
+
+			/* The same name asked twice gets the same ID */
+			for (j = 0; j < new_count; j++) {
+				if (new_nameid[j].ulKind == nameid[i].ulKind
+				    && GUID_equal(&new_nameid[j].lpguid, &nameid[i].lpguid)
+				    && ((nameid[i].ulKind == MNID_ID && new_nameid[j].kind.lid == nameid[i].kind.lid)
+					|| (nameid[i].ulKind == MNID_STRING
+					    && !strcmp(new_nameid[j].kind.lpwstr.Name, nameid[i].kind.lpwstr.Name)))) {
+					break;
+				}
+			}
+			if (j == new_count) {
+				new_nameid[new_count] = nameid[i];
+				new_propID[new_count] = mapped_id++;
+				new_count++;
+			}
+			propID[i] = new_propID[j];
+		}
+
+		if (new_count) {
+			retval = mapistore_namedprops_create_ids(nprops_ctx, new_count, new_nameid, new_propID);
+			if (mapistore_namedprops_transaction_commit(nprops_ctx) != MAPISTORE_SUCCESS
+			    || retval != MAPISTORE_SUCCESS) {
+				return MAPI_E_UNABLE_TO_COMPLETE;
+			}
+		}
+	} else {
+		for (i = 0; i < count; i++) {
+			if (propID[i]) continue;
+
+			lpguid = &nameid[i].lpguid;
 			OC_DEBUG(5, "  no mapping for property %.8x-%.4x-%.4x-%.2x%.2x-%.2x%.2x%.2x%.2x%.2x%.2x:",
 				  lpguid->time_low, lpguid->time_mid, lpguid->time_hi_and_version,
 				  lpguid->clock_seq[0], lpguid->clock_seq[1],
@@ -1197,10 +1267,10 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertyIdsFromNames(TALLOC_CTX *mem_ctx,
 				  lpguid->node[2], lpguid->node[3],
 				  lpguid->node[4], lpguid->node[5]);
 
-			if (mapi_req->u.mapi_GetIDsFromNames.nameid[i].ulKind == MNID_ID) {
-				OC_DEBUG(5, "%.4x\n", mapi_req->u.mapi_GetIDsFromNames.nameid[i].kind.lid);
-			} else if (mapi_req->u.mapi_GetIDsFromNames.nameid[i].ulKind == MNID_STRING) {
-				OC_DEBUG(5, "%s\n", mapi_req->u.mapi_GetIDsFromNames.nameid[i].kind.lpwstr.Name);
+			if (nameid[i].ulKind == MNID_ID) {
+				OC_DEBUG(5, "%.4x\n", nameid[i].kind.lid);
+			} else if (nameid[i].ulKind == MNID_STRING) {
+				OC_DEBUG(5, "%s\n", nameid[i].kind.lpwstr.Name);
 			} else {
 				OC_DEBUG(5, "[invalid ulKind]");
 			}
@@ -1209,15 +1279,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertyIdsFromNames(TALLOC_CTX *mem_ctx,
 		}
 	}
 
-	if (has_transaction) {
-		enum mapistore_error err = mapistore_namedprops_transaction_commit(emsmdbp_ctx->mstore_ctx->nprops_ctx);
-		if (err != MAPISTORE_SUCCESS) {
-			return MAPI_E_UNABLE_TO_COMPLETE;
-		}
-	}
-
-	*size += libmapiserver_RopGetPropertyIdsFromNames_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1232,7 +1293,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPropertyIdsFromNames(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the GetNamesFromIDs
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
 */
@@ -1279,8 +1340,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetNamesFromIDs(TALLOC_CTX *mem_ctx,
 		}
 	}
 
-	*size += libmapiserver_RopGetNamesFromIDs_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1295,7 +1354,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetNamesFromIDs(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the DeletePropertiesNoReplicate
    EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
 */
@@ -1321,8 +1380,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeletePropertiesNoReplicate(TALLOC_CTX *mem_
 	mapi_repl->u.mapi_DeletePropertiesNoReplicate.PropertyProblemCount = 0;
 	mapi_repl->u.mapi_DeletePropertiesNoReplicate.PropertyProblem = NULL;
 
-	*size += libmapiserver_RopDeletePropertiesNoReplicate_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -1337,7 +1394,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopDeletePropertiesNoReplicate(TALLOC_CTX *mem_
    \param mapi_repl pointer to the DeleteProperties EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1426,7 +1483,5 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopCopyTo(TALLOC_CTX *mem_ctx,
 	mapi_repl->error_code = emsmdbp_object_copy_properties(emsmdbp_ctx, source_object, dest_object, &excluded_tags, request->WantSubObjects);
 
 end:
-	*size += libmapiserver_RopCopyTo_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
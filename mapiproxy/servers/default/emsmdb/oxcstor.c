@@ -53,7 +53,9 @@ static enum MAPISTATUS RopLogon_Mailbox(TALLOC_CTX *mem_ctx,
 	const char * const	attrs[] = { "*", NULL };
 	enum MAPISTATUS		ret;
 	struct ldb_result	*res = NULL;
+	struct emsmdbp_logon_record	record;
 	const char		*username;
+	const char		*node;
 	struct tm		*LogonTime;
 	time_t			t;
 	NTTIME			nttime;
@@ -72,32 +74,39 @@ static enum MAPISTATUS RopLogon_Mailbox(TALLOC_CTX *mem_ctx,
 	username = ldb_msg_find_attr_as_string(res->msgs[0], "sAMAccountName", NULL);
 	OPENCHANGE_RETVAL_IF(!username, ecUnknownUser, NULL);
 
-	/* Step 2. Init and or update the user mailbox (auto-provisioning) */
-	ret = emsmdbp_mailbox_provision(emsmdbp_ctx, username);
-	OPENCHANGE_RETVAL_IF(ret != MAPI_E_SUCCESS, MAPI_E_DISK_ERROR, NULL);
-	/* TODO: freebusy entry should be created only during freebusy lookups */
-	if (strncmp(username, emsmdbp_ctx->username, strlen(username)) == 0) {
-		ret = emsmdbp_mailbox_provision_public_freebusy(emsmdbp_ctx, request->EssDN);
-		OPENCHANGE_RETVAL_IF(ret != MAPI_E_SUCCESS, MAPI_E_DISK_ERROR, NULL);
+	/* The mailbox is served by another node of the cluster */
+	node = mapiproxy_shard_redirect(emsmdbp_ctx->lp_ctx, username);
+	if (node) {
+		OC_DEBUG(3, "exchange_emsmdb: [OXCSTOR] mailbox of %s is served by %s\n", username, node);
+		mapi_repl->us.mapi_Logon.LogonFlags = request->LogonFlags;
+		mapi_repl->us.mapi_Logon.ServerNameSize = strlen(node) + 1;
+		mapi_repl->us.mapi_Logon.ServerName = talloc_strdup(mem_ctx, node);
+		OPENCHANGE_RETVAL_IF(!mapi_repl->us.mapi_Logon.ServerName, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		return ecWrongServer;
 	}
 
+	/* Step 2. Init and or update the user mailbox (auto-provisioning)
+	 * unless a valid logon record is cached */
+	ret = emsmdbp_logon_record_get(emsmdbp_ctx, username, request->EssDN, &record);
+	OPENCHANGE_RETVAL_IF(ret != MAPI_E_SUCCESS, MAPI_E_DISK_ERROR, NULL);
+
 	/* Step 3. Set LogonFlags */
 	response->LogonFlags = request->LogonFlags;
 
 	/* Step 4. Build FolderIds list */
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_MAILBOX_ROOT, &response->LogonType.store_mailbox.Root);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_DEFERRED_ACTION, &response->LogonType.store_mailbox.DeferredAction);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_SPOOLER_QUEUE, &response->LogonType.store_mailbox.SpoolerQueue);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_TOP_INFORMATION_STORE, &response->LogonType.store_mailbox.IPMSubTree);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_INBOX, &response->LogonType.store_mailbox.Inbox);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_OUTBOX, &response->LogonType.store_mailbox.Outbox);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_SENT_ITEMS, &response->LogonType.store_mailbox.SentItems);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_DELETED_ITEMS, &response->LogonType.store_mailbox.DeletedItems);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_COMMON_VIEWS, &response->LogonType.store_mailbox.CommonViews);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_SCHEDULE, &response->LogonType.store_mailbox.Schedule);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_SEARCH, &response->LogonType.store_mailbox.Search);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_VIEWS, &response->LogonType.store_mailbox.Views);
-	openchangedb_get_SystemFolderID(emsmdbp_ctx->oc_ctx, username, EMSMDBP_SHORTCUTS, &response->LogonType.store_mailbox.Shortcuts);
+	response->LogonType.store_mailbox.Root = record.folders[0];
+	response->LogonType.store_mailbox.DeferredAction = record.folders[1];
+	response->LogonType.store_mailbox.SpoolerQueue = record.folders[2];
+	response->LogonType.store_mailbox.IPMSubTree = record.folders[3];
+	response->LogonType.store_mailbox.Inbox = record.folders[4];
+	response->LogonType.store_mailbox.Outbox = record.folders[5];
+	response->LogonType.store_mailbox.SentItems = record.folders[6];
+	response->LogonType.store_mailbox.DeletedItems = record.folders[7];
+	response->LogonType.store_mailbox.CommonViews = record.folders[8];
+	response->LogonType.store_mailbox.Schedule = record.folders[9];
+	response->LogonType.store_mailbox.Search = record.folders[10];
+	response->LogonType.store_mailbox.Views = record.folders[11];
+	response->LogonType.store_mailbox.Shortcuts = record.folders[12];
 
 	/* Step 5. Set ResponseFlags */
 	response->LogonType.store_mailbox.ResponseFlags = ResponseFlags_Reserved;
@@ -106,12 +115,11 @@ static enum MAPISTATUS RopLogon_Mailbox(TALLOC_CTX *mem_ctx,
 	}
 
 	/* Step 6. Retrieve MailboxGuid */
-	openchangedb_get_MailboxGuid(emsmdbp_ctx->oc_ctx, username, &response->LogonType.store_mailbox.MailboxGuid);
+	response->LogonType.store_mailbox.MailboxGuid = record.MailboxGuid;
 
 	/* Step 7. Retrieve mailbox replication information */
-	openchangedb_get_MailboxReplica(emsmdbp_ctx->oc_ctx, username,
-					&response->LogonType.store_mailbox.ReplId,
-					&response->LogonType.store_mailbox.ReplGUID);
+	response->LogonType.store_mailbox.ReplId = record.ReplId;
+	response->LogonType.store_mailbox.ReplGUID = record.ReplGUID;
 
 	/* Step 8. Set LogonTime both in openchange dispatcher database and reply */
 	t = time(NULL);
@@ -189,7 +197,7 @@ static enum MAPISTATUS RopLogon_PublicFolder(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the Logon EcDoRpc_MAPI_REPL structure
    the function returns
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \note Users are only allowed to open their own mailbox at the
    moment. This limitation will be removed when significant progress
@@ -230,13 +238,11 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopLogon(TALLOC_CTX *mem_ctx,
 	if (request->LogonFlags & LogonPrivate) {
 		retval = RopLogon_Mailbox(mem_ctx, emsmdbp_ctx, mapi_req, mapi_repl);
 		mapi_repl->error_code = retval;
-		*size += libmapiserver_RopLogon_size(mapi_req, mapi_repl);
 	} else {
 		retval = RopLogon_PublicFolder(mem_ctx, emsmdbp_ctx, mapi_req, mapi_repl);
 		/* mapi_repl->error_code = MAPI_E_LOGON_FAILED; */
 		mapi_repl->error_code = retval;
 		mailboxstore = false;
-		*size += libmapiserver_RopLogon_size(mapi_req, mapi_repl);
 
 		/*
 		 * EssDN for public logons may be empty string
@@ -267,7 +273,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopLogon(TALLOC_CTX *mem_ctx,
    \param emsmdbp_ctx pointer to the emsmdb provider context
    \param request pointer to the Release EcDoRpc_MAPI_REQ
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -434,7 +440,7 @@ static enum MAPISTATUS RopSetReceiveFolder(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the SetReceiveFolder EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the SetReceiveFolder EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -462,8 +468,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetReceiveFolder(TALLOC_CTX *mem_ctx,
 	mapi_repl->handle_idx = mapi_req->handle_idx;
 	mapi_repl->error_code = retval;
 
-	*size += libmapiserver_RopSetReceiveFolder_size(mapi_repl);
-	
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return retval;
@@ -545,7 +549,7 @@ static enum MAPISTATUS RopGetReceiveFolder(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the GetReceiveFolder EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetReceiveFolder EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -573,8 +577,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetReceiveFolder(TALLOC_CTX *mem_ctx,
 	mapi_repl->handle_idx = mapi_req->handle_idx;
 	mapi_repl->error_code = retval;
 
-	*size += libmapiserver_RopGetReceiveFolder_size(mapi_repl);
-	
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return retval;
@@ -639,7 +641,7 @@ static enum MAPISTATUS RopGetReceiveFolderTable(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the GetReceiveFolderTable EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetReceiveFolderTable EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
 */
@@ -667,8 +669,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetReceiveFolderTable(TALLOC_CTX *mem_ctx,
 	mapi_repl->handle_idx = mapi_req->handle_idx;
 	mapi_repl->error_code = retval;
 
-	*size = libmapiserver_RopGetReceiveFolderTable_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return retval;
@@ -684,7 +684,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetReceiveFolderTable(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the LongTermIdFromId EcDoRpc_MAPI_REPL structure
 
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -756,8 +756,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopLongTermIdFromId(TALLOC_CTX *mem_ctx,
 	response->LongTermId.padding = 0;
 
 end:
-	*size += libmapiserver_RopLongTermIdFromId_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -775,7 +773,7 @@ end:
    EcDoRpc_MAPI_REPL structure
 
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -861,8 +859,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopIdFromLongTermId(TALLOC_CTX *mem_ctx,
 	response->Id = fmid << 16 | repl_id;
 
 end:
-	*size += libmapiserver_RopIdFromLongTermId_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -876,7 +872,7 @@ end:
    \param mapi_req pointer to the GetPerUserLongTermIds EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetPerUserLongTermIds EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -908,8 +904,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPerUserLongTermIds(TALLOC_CTX *mem_ctx,
 	mapi_repl->u.mapi_GetPerUserLongTermIds.LongTermIdCount = 0;
 	mapi_repl->u.mapi_GetPerUserLongTermIds.LongTermIds = NULL;
 
-	*size += libmapiserver_RopGetPerUserLongTermIds_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -925,7 +919,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPerUserLongTermIds(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the GetPerUserLongTermIds EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetPerUserLongTermIds EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -955,7 +949,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPerUserGuid(TALLOC_CTX *mem_ctx,
 
 	/* TODO effective work here */
 
-	*size += libmapiserver_RopGetPerUserGuid_size(mapi_repl);
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -970,7 +963,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetPerUserGuid(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the ReadPerUserInformation EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the ReadPerUserInformation EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -998,7 +991,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopReadPerUserInformation(TALLOC_CTX *mem_ctx,
 	mapi_repl->u.mapi_ReadPerUserInformation.Data.length = 0x0;
 	mapi_repl->u.mapi_ReadPerUserInformation.Data.data = NULL;
 
-	*size += libmapiserver_RopReadPerUserInformation_size(mapi_repl);
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -1013,7 +1005,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopReadPerUserInformation(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the GetStoreState EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetStoreState EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1036,7 +1028,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetStoreState(TALLOC_CTX *mem_ctx,
 	mapi_repl->handle_idx = mapi_req->handle_idx;
 	mapi_repl->error_code = MAPI_E_NOT_IMPLEMENTED;
 
-	*size += libmapiserver_RopGetStoreState_size(mapi_repl);
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
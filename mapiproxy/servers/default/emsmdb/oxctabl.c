@@ -42,7 +42,7 @@
    \param mapi_repl pointer to the SetColumns EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -57,6 +57,8 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetColumns(TALLOC_CTX *mem_ctx,
 	struct emsmdbp_object		*object;
 	struct emsmdbp_object_table	*table;
 	struct SetColumns_req		request;
+	enum MAPITAGS			*columns;
+	uint16_t			i;
 	void				*data = NULL;
 	uint32_t			handle;
 
@@ -75,8 +77,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetColumns(TALLOC_CTX *mem_ctx,
 	mapi_repl->error_code = MAPI_E_SUCCESS;
 	mapi_repl->u.mapi_SetColumns.TableStatus = TBLSTAT_COMPLETE;
 
-	*size += libmapiserver_RopSetColumns_size(mapi_repl);
-
 	handle = handles[mapi_req->handle_idx];
 	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
 	if (retval) {
@@ -98,21 +98,37 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetColumns(TALLOC_CTX *mem_ctx,
 		table = object->object.table;
 		OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
 
-		if (table->ulType == MAPISTORE_RULE_TABLE) {
-			OC_DEBUG(5, "  query on rules table are all faked right now\n");
-			goto end;
-		}
-
 		request = mapi_req->u.mapi_SetColumns;
 
 		if (request.prop_count) {
+			emsmdbp_object_table_cache_reset(table);
 			table->prop_count = request.prop_count;
 			table->properties = talloc_memdup(table, request.properties, 
 							  request.prop_count * sizeof (uint32_t));
-                        if (emsmdbp_is_mapistore(object)) {
+			if (table->ulType == MAPISTORE_RULE_TABLE) {
+				OC_DEBUG(5, "object: Setting Columns on rules table\n");
+			} else if (emsmdbp_is_mapistore(object)) {
 				OC_DEBUG(5, "object: %p, backend_object: %p\n", object, object->backend_object);
+				columns = request.properties;
+				table->attach_data_deferred = false;
+				if (table->ulType == MAPISTORE_ATTACHMENT_TABLE &&
+				    lpcfg_parm_bool(emsmdbp_ctx->lp_ctx, NULL, "emsmdb", "attachment_table_metadata", false)) {
+					/* Ask the backend for the attachment number
+					   instead of the attachment bytes, see
+					   emsmdbp_object_table_row_from_properties */
+					columns = talloc_memdup(mem_ctx, request.properties, request.prop_count * sizeof (uint32_t));
+					for (i = 0; columns && i < request.prop_count; i++) {
+						if ((columns[i] >> 16) == (PidTagAttachDataBinary >> 16)) {
+							columns[i] = PidTagAttachNumber;
+							table->attach_data_deferred = true;
+						}
+					}
+					if (!columns) {
+						columns = request.properties;
+					}
+				}
 				mapistore_table_set_columns(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object),
-							    object->backend_object, request.prop_count, request.properties);
+							    object->backend_object, request.prop_count, columns);
                         } else {
 				/* openchangedb case */
 				OC_DEBUG(5, "object: Setting Columns on openchangedb table\n");
@@ -136,7 +152,7 @@ end:
    \param mapi_repl pointer to the SortTable EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -152,9 +168,11 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSortTable(TALLOC_CTX *mem_ctx,
 	struct emsmdbp_object		*object;
 	struct emsmdbp_object_table	*table;
 	struct SortTable_req		*request;
+	struct SSortOrderSet		*backend_sort;
 	uint32_t			handle;
 	void				*data = NULL;
 	uint8_t				status;
+	uint16_t			i;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] SortTable (0x13)\n");
 
@@ -213,19 +231,44 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSortTable(TALLOC_CTX *mem_ctx,
 
         /* we reset the cursor to the beginning of the table */
         table->numerator = 0;
-
-        /* TODO: we should invalidate current bookmarks on the table */
+	emsmdbp_object_table_cache_reset(table);
+	emsmdbp_object_table_bookmarks_reset(table);
+	emsmdbp_object_table_categories_reset(table);
+	table->sort_proptag = 0;
 
 	/* If parent folder has a mapistore context */
 	request = &mapi_req->u.mapi_SortTable;
 	if (emsmdbp_is_mapistore(object)) {
+		/* Conversation identifiers are derived from the topic: let the backend sort on it */
+		backend_sort = &request->lpSortCriteria;
+		for (i = 0; i < request->lpSortCriteria.cSorts; i++) {
+			if (!emsmdbp_conversation_column(request->lpSortCriteria.aSort[i].ulPropTag)) continue;
+			if (backend_sort == &request->lpSortCriteria) {
+				backend_sort = talloc_memdup(mem_ctx, &request->lpSortCriteria, sizeof (struct SSortOrderSet));
+				OPENCHANGE_RETVAL_IF(!backend_sort, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+				backend_sort->aSort = talloc_memdup(backend_sort, request->lpSortCriteria.aSort,
+								    request->lpSortCriteria.cSorts * sizeof (struct SSortOrder));
+				OPENCHANGE_RETVAL_IF(!backend_sort->aSort, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+			}
+			backend_sort->aSort[i].ulPropTag = PidTagConversationTopic;
+		}
+
 		status = TBLSTAT_COMPLETE;
-		mretval = mapistore_table_set_sort_order(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object), object->backend_object, &request->lpSortCriteria, &status);
+		mretval = mapistore_table_set_sort_order(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object), object->backend_object, backend_sort, &status);
                 if (mretval) {
 			mapi_repl->error_code = mapistore_error_to_mapi(mretval);
 			goto end;
 		}
 		mapi_repl->u.mapi_SortTable.TableStatus = status;
+
+		/* Header rows are computed here, backends only sort */
+		if (request->lpSortCriteria.cCategories) {
+			retval = emsmdbp_object_table_categorize(emsmdbp_ctx, object, &request->lpSortCriteria);
+			if (retval) {
+				mapi_repl->error_code = retval;
+				goto end;
+			}
+		}
 	} else {
 		/* Parent folder doesn't have any mapistore context associated */
 		status = TBLSTAT_COMPLETE;
@@ -236,10 +279,14 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSortTable(TALLOC_CTX *mem_ctx,
 			goto end;
 		}
 	}
+
+	/* Remember the leading sort column for FindRow */
+	if (request->lpSortCriteria.cSorts) {
+		table->sort_proptag = request->lpSortCriteria.aSort[0].ulPropTag;
+		table->sort_order = request->lpSortCriteria.aSort[0].ulOrder;
+	}
         
 end:
-	*size += libmapiserver_RopSortTable_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -254,7 +301,7 @@ end:
    \param mapi_repl pointer to the Restrict EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -317,8 +364,14 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopRestrict(TALLOC_CTX *mem_ctx,
 	OPENCHANGE_RETVAL_IF(!table, MAPI_E_INVALID_PARAMETER, NULL);
 
 	table->restricted = true;
+	emsmdbp_object_table_cache_reset(table);
+	emsmdbp_object_table_bookmarks_reset(table);
 	if (table->ulType == MAPISTORE_RULE_TABLE) {
-		OC_DEBUG(5, "  query on rules table are all faked right now\n");
+		OC_DEBUG(5, "  restrictions on rules tables are ignored\n");
+		goto end;
+	}
+	if (table->search) {
+		OC_DEBUG(5, "  restrictions on search folder tables are ignored\n");
 		goto end;
 	}
  
@@ -334,6 +387,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopRestrict(TALLOC_CTX *mem_ctx,
 
 		table->numerator = 0;
 		mapistore_table_get_row_count(emsmdbp_ctx->mstore_ctx, contextID, object->backend_object, MAPISTORE_PREFILTERED_QUERY, &object->object.table->denominator);
+		emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, true);
 
 		mapi_repl->u.mapi_Restrict.TableStatus = status;
 
@@ -344,8 +398,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopRestrict(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopRestrict_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;	
 }
 
@@ -360,7 +412,7 @@ end:
    \param mapi_repl pointer to the QueryRows EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
  */
 _PUBLIC_ enum MAPISTATUS EcDoRpc_RopQueryRows(TALLOC_CTX *mem_ctx,
 					      struct emsmdbp_context *emsmdbp_ctx,
@@ -379,10 +431,13 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopQueryRows(TALLOC_CTX *mem_ctx,
 	enum mapistore_error		mretval;
 	uint64_t			folderID;
 	void				**data_pointers;
-	uint32_t			count;
+	struct emsmdbp_table_row_props	*rows;
+	uint32_t			count, fetched, batch, j;
+	uint32_t			row_count;
 	uint32_t			handle;
 	uint16_t			flags = 0;
 	int64_t			        i = 0, end;
+	size_t				row_offset;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] QueryRows (0x15)\n");
 
@@ -431,10 +486,8 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopQueryRows(TALLOC_CTX *mem_ctx,
 	table = object->object.table;
 
 	count = 0;
-	if (table->ulType == MAPISTORE_RULE_TABLE) {
-		OC_DEBUG(5, "  query on rules table are all faked right now\n");
-		goto finish;
-	}
+	emsmdbp_search_table_refresh(emsmdbp_ctx, object);
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
 
 	/* Lookup the properties */
 	if (request->ForwardRead) {
@@ -459,8 +512,13 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopQueryRows(TALLOC_CTX *mem_ctx,
 		switch (table->numerator) {
 		case 0x0:
 			count = 0;
-			retval = emsmdbp_object_table_get_recursive_row_props(mem_ctx, emsmdbp_ctx, object, &response->RowData,
-									      &SPropTagArray, 0, &end, &count);
+			/* openchangedb reads the whole tree at once when it can */
+			retval = emsmdbp_object_table_get_folder_tree_rows(mem_ctx, emsmdbp_ctx, object, &response->RowData,
+									   &SPropTagArray, &end, &count);
+			if (retval == MAPI_E_NO_SUPPORT || retval == MAPI_E_NOT_IMPLEMENTED || retval == MAPI_E_NOT_FOUND) {
+				retval = emsmdbp_object_table_get_recursive_row_props(mem_ctx, emsmdbp_ctx, object, &response->RowData,
+										      &SPropTagArray, 0, &end, &count);
+			}
 			if (retval != MAPI_E_SUCCESS) {
 				OC_DEBUG(OC_LOG_WARNING, "Unable to retrieve recursive folder rows");
 				count = 0;
@@ -472,13 +530,66 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopQueryRows(TALLOC_CTX *mem_ctx,
 			break;
 		}
 	} else {
+		/* Only rows of tables whose changes are notified are cached */
+		if (!table->categories && table->subscription && emsmdbp_is_mapistore(object) &&
+		    mapistore_table_get_row_count(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object),
+						  object->backend_object, MAPISTORE_PREFILTERED_QUERY,
+						  &row_count) == MAPISTORE_SUCCESS) {
+			emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, row_count);
+		} else {
+			emsmdbp_object_table_cache_reset(table);
+		}
+
 		i = table->numerator;
 		while (i != end) {
+			if (table->categories) {
+				if (!emsmdbp_object_table_category_fill_row(mem_ctx, emsmdbp_ctx, object, i, &response->RowData)) {
+					count = 0;
+					goto finish;
+				}
+				count++;
+				i = (request->ForwardRead) ? i + 1 : i - 1;
+				continue;
+			}
+
+			/* Outlook queries the same window again on each scroll or refresh */
+			if (emsmdbp_object_table_cache_fetch(mem_ctx, emsmdbp_ctx, table, i, &response->RowData)) {
+				count++;
+				i = (request->ForwardRead) ? i + 1 : i - 1;
+				continue;
+			}
+
+			if (request->ForwardRead && emsmdbp_is_mapistore(object) && table->ulType != MAPISTORE_RULE_TABLE) {
+				batch = end - i;
+				if (batch > EMSMDBP_TABLE_ROW_CACHE_SIZE) {
+					batch = EMSMDBP_TABLE_ROW_CACHE_SIZE;
+				}
+				rows = emsmdbp_object_table_get_rows_props(mem_ctx, emsmdbp_ctx, object, i, batch,
+									   MAPISTORE_PREFILTERED_QUERY, &fetched);
+				if (rows) {
+					for (j = 0; j < fetched; j++, i++, count++) {
+						row_offset = response->RowData.length;
+						emsmdbp_fill_table_row_blob(mem_ctx, emsmdbp_ctx,
+									    &response->RowData, table->prop_count,
+									    table->properties, rows[j].data_pointers, rows[j].retvals);
+						emsmdbp_object_table_cache_store(emsmdbp_ctx, table, i,
+										 response->RowData.data + row_offset,
+										 response->RowData.length - row_offset);
+					}
+					talloc_free(rows);
+					continue;
+				}
+			}
+
 			data_pointers = emsmdbp_object_table_get_row_props(mem_ctx, emsmdbp_ctx, object, i, MAPISTORE_PREFILTERED_QUERY, &retvals);
 			if (data_pointers) {
+				row_offset = response->RowData.length;
 				emsmdbp_fill_table_row_blob(mem_ctx, emsmdbp_ctx,
 							    &response->RowData, table->prop_count,
 							    table->properties, data_pointers, retvals);
+				emsmdbp_object_table_cache_store(emsmdbp_ctx, table, i,
+								 response->RowData.data + row_offset,
+								 response->RowData.length - row_offset);
 				talloc_free(retvals);
 				talloc_free(data_pointers);
 				count++;
@@ -554,8 +665,6 @@ finish:
 	}
 
 end:
-	*size += libmapiserver_RopQueryRows_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -569,7 +678,7 @@ end:
    \param mapi_req pointer to the QueryPosition EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the QueryPosition EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -621,14 +730,14 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopQueryPosition(TALLOC_CTX *mem_ctx,
 	}
 
 	table = object->object.table;
+	emsmdbp_search_table_refresh(emsmdbp_ctx, object);
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
 
         mapi_repl->u.mapi_QueryPosition.Numerator = table->numerator;
 	mapi_repl->u.mapi_QueryPosition.Denominator = table->denominator;
 	mapi_repl->error_code = MAPI_E_SUCCESS;
 
 end:
-	*size += libmapiserver_RopQueryPosition_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -642,7 +751,7 @@ end:
    \param mapi_req pointer to the SeekRow EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the SeekRow EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -702,6 +811,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSeekRow(TALLOC_CTX *mem_ctx,
 	 * entire table, nor do we handle bookmarks */
 
 	table = object->object.table;
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
 	if (mapi_req->u.mapi_SeekRow.origin == BOOKMARK_BEGINNING) {
                 next_position = mapi_req->u.mapi_SeekRow.offset;
 	}
@@ -736,12 +846,379 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSeekRow(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopSeekRow_size(mapi_repl);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc SeekRowBookmark (0x19) Rop. This operation moves
+   the cursor to a position in a table relative to a bookmark.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the SeekRowBookmark EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the SeekRowBookmark EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopSeekRowBookmark(TALLOC_CTX *mem_ctx,
+						    struct emsmdbp_context *emsmdbp_ctx,
+						    struct EcDoRpc_MAPI_REQ *mapi_req,
+						    struct EcDoRpc_MAPI_REPL *mapi_repl,
+						    uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_table_bookmark	*bookmark;
+	struct SeekRowBookmark_req	*request;
+	void				*data;
+	uint32_t			row_id;
+	int64_t				origin;
+	int64_t				next_position;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] SeekRowBookmark (0x19)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	request = &mapi_req->u.mapi_SeekRowBookmark;
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->u.mapi_SeekRowBookmark.RowNoLongerVisible = 0;
+	mapi_repl->u.mapi_SeekRowBookmark.HasSoughtLess = 0;
+	mapi_repl->u.mapi_SeekRowBookmark.RowsSought = 0;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
+
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	bookmark = emsmdbp_object_table_bookmark_find(table, &request->Bookmark);
+	if (!bookmark) {
+		mapi_repl->error_code = MAPI_E_INVALID_BOOKMARK;
+		OC_DEBUG(5, "  invalid bookmark\n");
+		goto end;
+	}
+
+	/* The bookmarked row was removed: seek from where it used to be */
+	if (!emsmdbp_object_table_bookmark_locate(emsmdbp_ctx, object, bookmark, &row_id)) {
+		mapi_repl->u.mapi_SeekRowBookmark.RowNoLongerVisible = 1;
+	}
+	origin = row_id;
+
+	next_position = origin + (int32_t) request->RowCount;
+	if (next_position < 0) {
+		next_position = 0;
+		mapi_repl->u.mapi_SeekRowBookmark.HasSoughtLess = 1;
+	}
+	else if (next_position > table->denominator) {
+		next_position = table->denominator;
+		mapi_repl->u.mapi_SeekRowBookmark.HasSoughtLess = 1;
+	}
+
+	if (request->WantRowMovedCount) {
+		mapi_repl->u.mapi_SeekRowBookmark.RowsSought = (uint32_t)(next_position - origin);
+	}
+	table->numerator = next_position;
+
+end:
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc CreateBookmark (0x1b) Rop. This operation creates
+   a bookmark on the current cursor position of a table.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the CreateBookmark EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the CreateBookmark EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopCreateBookmark(TALLOC_CTX *mem_ctx,
+						   struct emsmdbp_context *emsmdbp_ctx,
+						   struct EcDoRpc_MAPI_REQ *mapi_req,
+						   struct EcDoRpc_MAPI_REPL *mapi_repl,
+						   uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	void				*data;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] CreateBookmark (0x1b)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->u.mapi_CreateBookmark.bookmark.cb = 0;
+	mapi_repl->u.mapi_CreateBookmark.bookmark.lpb = NULL;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
 
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	mapi_repl->error_code = emsmdbp_object_table_bookmark_create(emsmdbp_ctx, object, table->numerator,
+								     &mapi_repl->u.mapi_CreateBookmark.bookmark);
+
+end:
 	return MAPI_E_SUCCESS;
 }
 
 
+/**
+   \details Tell whether a property type holds a signed integer
+ */
+static bool oxctabl_findrow_is_signed(enum MAPITAGS proptag)
+{
+	switch (proptag & 0xFFFF) {
+	case PT_I2:
+	case PT_LONG:
+	case PT_I8:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+/**
+   \details Evaluate the FindRow bound against a row of a sorted table
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param object pointer to the table object
+   \param program pointer to the compiled bound
+   \param column index of the sort column in the column set
+   \param row_id position of the row to probe
+   \param match pointer to the result of the bound on the row
+   \param negative pointer set to true if the sort column of the row
+   holds a negative integer
+
+   \return true on success, false if the row or its sort column could
+   not be read
+ */
+static bool oxctabl_findrow_probe(struct emsmdbp_context *emsmdbp_ctx,
+				  struct emsmdbp_object *object,
+				  struct mapiproxy_restriction *program,
+				  uint32_t column, uint32_t row_id,
+				  bool *match, bool *negative)
+{
+	struct emsmdbp_object_table	*table = object->object.table;
+	enum MAPISTATUS			*retvals;
+	void				**data_pointers;
+	const void			*data;
+
+	data_pointers = emsmdbp_object_table_get_row_props(program, emsmdbp_ctx, object, row_id,
+							   MAPISTORE_PREFILTERED_QUERY, &retvals);
+	if (!data_pointers) {
+		return false;
+	}
+	if (retvals[column] != MAPI_E_SUCCESS || !data_pointers[column]) {
+		talloc_free(retvals);
+		talloc_free(data_pointers);
+		return false;
+	}
+
+	data = data_pointers[column];
+	switch (table->sort_proptag & 0xFFFF) {
+	case PT_I2:
+		*negative = (*(const int16_t *)data < 0);
+		break;
+	case PT_LONG:
+		*negative = (*(const int32_t *)data < 0);
+		break;
+	case PT_I8:
+		*negative = (*(const int64_t *)data < 0);
+		break;
+	default:
+		*negative = false;
+		break;
+	}
+
+	*match = emsmdbp_object_table_row_match(table, program, data_pointers, retvals);
+	talloc_free(retvals);
+	talloc_free(data_pointers);
+
+	return true;
+}
+
+
+/**
+   \details Move the cursor of a sorted table to the first row that
+   may match a FindRow restriction
+
+   When the restriction compares the leading sort column, the rows
+   that cannot match form a prefix of the table and the first
+   candidate is found with a binary search instead of a full scan.
+   This only holds when the backend orders the column the way
+   restrictions compare it, which is the case for numeric and time
+   columns: strings are sorted with the backend collation and
+   multi-valued columns are sorted on their instances, so both keep
+   the linear scan. The cursor is also left untouched when the
+   restriction, the sort order or the column set do not allow it, or
+   when a probed row lacks the sort column.
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param object pointer to the table object
+   \param res pointer to the FindRow restriction
+ */
+static void oxctabl_findrow_seek(struct emsmdbp_context *emsmdbp_ctx,
+				 struct emsmdbp_object *object,
+				 struct mapi_SRestriction *res)
+{
+	struct emsmdbp_object_table	*table;
+	struct mapiproxy_restriction	*program;
+	struct mapi_SRestriction	bound;
+	uint32_t			low, high, middle;
+	uint32_t			i;
+	uint8_t				relop;
+	bool				match;
+	bool				negative;
+
+	table = object->object.table;
+	if (table->categories || !table->sort_proptag || res->rt != RES_PROPERTY
+	    || res->res.resProperty.ulPropTag != table->sort_proptag
+	    || (res->res.resProperty.lpProp.ulPropTag & 0xFFFF) != (table->sort_proptag & 0xFFFF)) {
+		return;
+	}
+
+	switch (table->sort_proptag & 0xFFFF) {
+	case PT_I2:
+	case PT_LONG:
+	case PT_BOOLEAN:
+	case PT_I8:
+	case PT_SYSTIME:
+	case PT_DOUBLE:
+		break;
+	default:
+		return;
+	}
+
+	for (i = 0; i < table->prop_count; i++) {
+		if (table->properties[i] == table->sort_proptag) break;
+	}
+	if (i == table->prop_count) {
+		return;
+	}
+
+	/* Turn the restriction into a bound that holds on a suffix of the table */
+	relop = res->res.resProperty.relop;
+	if (table->sort_order == TABLE_SORT_ASCEND && (relop == RELOP_EQ || relop == RELOP_GE)) {
+		relop = RELOP_GE;
+	} else if (table->sort_order == TABLE_SORT_DESCEND && (relop == RELOP_EQ || relop == RELOP_LE)) {
+		relop = RELOP_LE;
+	} else if (!((table->sort_order == TABLE_SORT_ASCEND && relop == RELOP_GT)
+		     || (table->sort_order == TABLE_SORT_DESCEND && relop == RELOP_LT))) {
+		return;
+	}
+
+	bound = *res;
+	bound.res.resProperty.relop = relop;
+	if (mapiproxy_restriction_compile(NULL, &bound, &program) != MAPI_E_SUCCESS) {
+		return;
+	}
+
+	low = table->numerator;
+	high = table->denominator;
+
+	/* Restrictions compare integers unsigned while backends sort them
+	   signed: both orders only agree when no row is negative, which
+	   the first and the last rows of the range tell */
+	if (low < high && oxctabl_findrow_is_signed(table->sort_proptag)) {
+		if (!oxctabl_findrow_probe(emsmdbp_ctx, object, program, i, low, &match, &negative) || negative
+		    || !oxctabl_findrow_probe(emsmdbp_ctx, object, program, i, high - 1, &match, &negative) || negative) {
+			talloc_free(program);
+			return;
+		}
+	}
+
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		if (!oxctabl_findrow_probe(emsmdbp_ctx, object, program, i, middle, &match, &negative)) {
+			talloc_free(program);
+			return;
+		}
+
+		if (match) {
+			high = middle;
+		} else {
+			low = middle + 1;
+		}
+	}
+	talloc_free(program);
+
+	OC_DEBUG(5, "  sorted FindRow: skipping rows %d to %d\n", table->numerator, low);
+	table->numerator = low;
+}
+
+
 /**
    \details EcDoRpc FindRow (0x4f) Rop. This operation moves the
    cursor to a row in a table that matches specific search criteria.
@@ -751,7 +1228,7 @@ end:
    \param mapi_req pointer to the FindRow EcDoRpc_MAPI_REQ structure
    \param mapi_repl pointer to the FindRow EcDoRpc_MAPI_REPL structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -777,6 +1254,11 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *mem_ctx,
 	uint8_t				status = 0;
 	uint32_t			i;
 	bool				found = false;
+	struct mapiproxy_restriction	*program = NULL;
+	struct emsmdbp_table_bookmark	*bookmark;
+	struct emsmdbp_table_category	*header;
+	uint32_t			row_id;
+	enum mapistore_query_type	query_type = MAPISTORE_LIVEFILTERED_QUERY;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] FindRow (0x4f)\n");
 
@@ -820,17 +1302,35 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *mem_ctx,
 		goto end;
 	}
 
-	/* We don't handle backward/forward yet , just go through the
-	 * entire table, nor do we handle bookmarks */
+	/* We don't handle backward yet, just go through the entire table */
 
 	table = object->object.table;
 	if (table->ulType == MAPISTORE_RULE_TABLE) {
-		OC_DEBUG(5, "  query on rules table are all faked right now\n");
+		OC_DEBUG(5, "  FindRow on rules tables is not supported\n");
 		goto end;
 	}
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
 
-	if (mapi_req->u.mapi_FindRow.origin == BOOKMARK_BEGINNING) {
+	switch (mapi_req->u.mapi_FindRow.origin) {
+	case BOOKMARK_BEGINNING:
 		table->numerator = 0;
+		break;
+	case BOOKMARK_END:
+		table->numerator = table->denominator;
+		break;
+	case BOOKMARK_USER:
+		bookmark = emsmdbp_object_table_bookmark_find(table, &request.bookmark);
+		if (!bookmark) {
+			mapi_repl->error_code = MAPI_E_INVALID_BOOKMARK;
+			OC_DEBUG(5, "  invalid bookmark\n");
+			goto end;
+		}
+		if (!emsmdbp_object_table_bookmark_locate(emsmdbp_ctx, object, bookmark, &table->numerator)) {
+			mapi_repl->u.mapi_FindRow.RowNoLongerVisible = 1;
+		}
+		break;
+	default:
+		break;
 	}
 	if (mapi_req->u.mapi_FindRow.ulFlags == DIR_BACKWARD) {
 		OC_DEBUG(5, "  only DIR_FORWARD is supported right now, using work-around\n");
@@ -841,10 +1341,21 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *mem_ctx,
 
 	switch ((int)emsmdbp_is_mapistore(object)) {
 	case true:
+		/* Skip the rows the sort order rules out */
+		if (mapi_req->u.mapi_FindRow.ulFlags == DIR_FORWARD) {
+			oxctabl_findrow_seek(emsmdbp_ctx, object, &request.res);
+		}
+
 		/* Restrict rows to be fetched */
 		mretval = mapistore_table_set_restrictions(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object), object->backend_object, &request.res, &status);
 		if (mretval != MAPISTORE_SUCCESS) {
 			OC_DEBUG(5, "mapistore_table_set_restrictions: %s\n", mapistore_errstr(mretval));
+			/* The backend cannot filter: evaluate the restriction on the column set */
+			if (mapiproxy_restriction_compile(mem_ctx, &request.res, &program) == MAPI_E_SUCCESS) {
+				query_type = MAPISTORE_PREFILTERED_QUERY;
+			} else {
+				program = NULL;
+			}
 		}
 		/* Then fetch rows */
 		/* Lookup the properties and check if we need to flag the PropertyRow blob */
@@ -852,7 +1363,20 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *mem_ctx,
 		while (!found && table->numerator < table->denominator) {
                         flagged = 0;
 
-			data_pointers = emsmdbp_object_table_get_row_props(NULL, emsmdbp_ctx, object, table->numerator, MAPISTORE_LIVEFILTERED_QUERY, &retvals);
+			/* Only leaf rows of categorized tables can match */
+			row_id = table->numerator;
+			if (table->categories
+			    && (!emsmdbp_object_table_category_locate(table, table->numerator, &header, &row_id) || header)) {
+				table->numerator++;
+				continue;
+			}
+
+			data_pointers = emsmdbp_object_table_get_row_props(NULL, emsmdbp_ctx, object, row_id, query_type, &retvals);
+			if (data_pointers && program && !emsmdbp_object_table_row_match(table, program, data_pointers, retvals)) {
+				talloc_free(retvals);
+				talloc_free(data_pointers);
+				data_pointers = NULL;
+			}
 			if (data_pointers) {
 				found = true;
 				for (i = 0; i < table->prop_count; i++) {
@@ -900,6 +1424,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *mem_ctx,
 		if (mretval != MAPISTORE_SUCCESS) {
 			OC_DEBUG(5, "mapistore_table_set_restrictions: %s\n", mapistore_errstr(mretval));
 		}
+		talloc_free(program);
 
 		/* Adjust parameters */
 		if (found) {
@@ -981,8 +1506,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopFindRow(TALLOC_CTX *mem_ctx,
 	}
 
 end:
-	*size += libmapiserver_RopFindRow_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -990,7 +1513,7 @@ end:
    \details EcDoRpc ResetTable (0x81) Rop. This operation resets the
    table as follows:
      - Removes the existing column set, restriction, and sort order (ignored) from the table.
-     - Invalidates bookmarks. (ignored)
+     - Invalidates bookmarks.
      - Resets the cursor to the beginning of the table.
 
    \param mem_ctx pointer to the memory context
@@ -1000,7 +1523,7 @@ end:
    \param mapi_repl pointer to the SetColumns EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -1031,7 +1554,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopResetTable(TALLOC_CTX *mem_ctx,
 	/* Initialize default empty ResetTable reply */
 	mapi_repl->opnum = mapi_req->opnum;
 	mapi_repl->handle_idx = mapi_req->handle_idx;
-	*size += libmapiserver_RopResetTable_size(mapi_repl);
 
 	handle = handles[mapi_req->handle_idx];
 	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
@@ -1060,9 +1582,19 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopResetTable(TALLOC_CTX *mem_ctx,
 
 	table = object->object.table;
 	if (table->ulType == MAPISTORE_RULE_TABLE) {
-		OC_DEBUG(5, "  query on rules table are all faked right now\n");
+		emsmdbp_object_table_cache_reset(table);
+		if (table->properties) {
+			talloc_free(table->properties);
+			table->properties = NULL;
+			table->prop_count = 0;
+		}
+		table->numerator = 0;
 	}
 	else {
+		emsmdbp_object_table_cache_reset(table);
+		emsmdbp_object_table_bookmarks_reset(table);
+		emsmdbp_object_table_categories_reset(table);
+
 		/* 1.1. removes the existing column set */
 		if (table->properties) {
 			talloc_free(table->properties);
@@ -1091,3 +1623,459 @@ end:
 
 	return MAPI_E_SUCCESS;
 }
+
+
+/**
+   \details EcDoRpc FreeBookmark (0x89) Rop. This operation releases
+   a bookmark previously created with CreateBookmark.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the FreeBookmark EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the FreeBookmark EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopFreeBookmark(TALLOC_CTX *mem_ctx,
+						 struct emsmdbp_context *emsmdbp_ctx,
+						 struct EcDoRpc_MAPI_REQ *mapi_req,
+						 struct EcDoRpc_MAPI_REPL *mapi_repl,
+						 uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	struct emsmdbp_table_bookmark	*bookmark;
+	void				*data;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] FreeBookmark (0x89)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
+
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	bookmark = emsmdbp_object_table_bookmark_find(table, &mapi_req->u.mapi_FreeBookmark.bookmark);
+	if (!bookmark) {
+		mapi_repl->error_code = MAPI_E_INVALID_BOOKMARK;
+		OC_DEBUG(5, "  invalid bookmark\n");
+		goto end;
+	}
+	DLIST_REMOVE(table->bookmarks, bookmark);
+	talloc_free(bookmark);
+
+end:
+	return MAPI_E_SUCCESS;
+}
+
+/**
+   \details EcDoRpc ExpandRow (0x59) Rop. This operation expands a collapsed
+   category of a table and returns the rows of the category.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the ExpandRow EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the ExpandRow EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopExpandRow(TALLOC_CTX *mem_ctx,
+					      struct emsmdbp_context *emsmdbp_ctx,
+					      struct EcDoRpc_MAPI_REQ *mapi_req,
+					      struct EcDoRpc_MAPI_REPL *mapi_repl,
+					      uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	void				*data;
+	struct emsmdbp_table_category	*header;
+	struct ExpandRow_req		*request;
+	struct ExpandRow_repl		*response;
+	uint32_t			count, i;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] ExpandRow (0x59)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+
+	request = &mapi_req->u.mapi_ExpandRow;
+	response = &mapi_repl->u.mapi_ExpandRow;
+	response->ExpandedRowCount = 0;
+	response->RowCount = 0;
+	response->RowData.length = 0;
+	response->RowData.data = NULL;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
+
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	if (!table->categories) {
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		OC_DEBUG(5, "  table is not categorized\n");
+		goto end;
+	}
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
+
+	header = emsmdbp_object_table_category_find(table, request->CategoryId);
+	if (!header) {
+		mapi_repl->error_code = MAPI_E_NOT_FOUND;
+		OC_DEBUG(5, "  category 0x%"PRIx64" not found\n", request->CategoryId);
+		goto end;
+	}
+
+	retval = emsmdbp_object_table_category_set_expanded(table, header, true, &count);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		goto end;
+	}
+
+	/* Return the first rows of the category */
+	for (i = 0; i < count && i < request->MaxRowCount; i++) {
+		if (!emsmdbp_object_table_category_fill_row(mem_ctx, emsmdbp_ctx, object, header->position + 1 + i, &response->RowData)) {
+			break;
+		}
+	}
+	response->ExpandedRowCount = count;
+	response->RowCount = i;
+
+end:
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc CollapseRow (0x5a) Rop. This operation collapses an expanded
+   category of a table.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the CollapseRow EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the CollapseRow EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopCollapseRow(TALLOC_CTX *mem_ctx,
+						struct emsmdbp_context *emsmdbp_ctx,
+						struct EcDoRpc_MAPI_REQ *mapi_req,
+						struct EcDoRpc_MAPI_REPL *mapi_repl,
+						uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	void				*data;
+	struct emsmdbp_table_category	*header;
+	uint64_t			category_id;
+	uint32_t			count;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] CollapseRow (0x5a)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->u.mapi_CollapseRow.CollapsedRowCount = 0;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
+
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	if (!table->categories) {
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		OC_DEBUG(5, "  table is not categorized\n");
+		goto end;
+	}
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
+
+	category_id = mapi_req->u.mapi_CollapseRow.CategoryId;
+	header = emsmdbp_object_table_category_find(table, category_id);
+	if (!header) {
+		mapi_repl->error_code = MAPI_E_NOT_FOUND;
+		OC_DEBUG(5, "  category 0x%"PRIx64" not found\n", category_id);
+		goto end;
+	}
+
+	retval = emsmdbp_object_table_category_set_expanded(table, header, false, &count);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		goto end;
+	}
+	mapi_repl->u.mapi_CollapseRow.CollapsedRowCount = count;
+
+end:
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc GetCollapseState (0x6b) Rop. This operation returns the state
+   of the categories of a table so it can be restored later.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the GetCollapseState EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the GetCollapseState EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetCollapseState(TALLOC_CTX *mem_ctx,
+						     struct emsmdbp_context *emsmdbp_ctx,
+						     struct EcDoRpc_MAPI_REQ *mapi_req,
+						     struct EcDoRpc_MAPI_REPL *mapi_repl,
+						     uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	void				*data;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] GetCollapseState (0x6b)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->u.mapi_GetCollapseState.CollapseState.cb = 0;
+	mapi_repl->u.mapi_GetCollapseState.CollapseState.lpb = NULL;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
+
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	if (!table->categories) {
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		OC_DEBUG(5, "  table is not categorized\n");
+		goto end;
+	}
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
+
+	mapi_repl->error_code = emsmdbp_object_table_categories_get_state(mem_ctx, table, mapi_req->u.mapi_GetCollapseState.RowId,
+									  &mapi_repl->u.mapi_GetCollapseState.CollapseState);
+
+end:
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details EcDoRpc SetCollapseState (0x6c) Rop. This operation restores the state
+   of the categories of a table and returns a bookmark on the restored
+   cursor position.
+
+   \param mem_ctx pointer to the memory context
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param mapi_req pointer to the SetCollapseState EcDoRpc_MAPI_REQ
+   structure
+   \param mapi_repl pointer to the SetCollapseState EcDoRpc_MAPI_REPL
+   structure
+   \param handles pointer to the MAPI handles array
+   \param size pointer to the size of the response built so far
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetCollapseState(TALLOC_CTX *mem_ctx,
+						     struct emsmdbp_context *emsmdbp_ctx,
+						     struct EcDoRpc_MAPI_REQ *mapi_req,
+						     struct EcDoRpc_MAPI_REPL *mapi_repl,
+						     uint32_t *handles, uint16_t *size)
+{
+	uint32_t			handle;
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	void				*data;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXCTABL] SetCollapseState (0x6c)\n");
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_req, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!mapi_repl, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!handles, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!size, MAPI_E_INVALID_PARAMETER, NULL);
+
+	mapi_repl->opnum = mapi_req->opnum;
+	mapi_repl->handle_idx = mapi_req->handle_idx;
+	mapi_repl->error_code = MAPI_E_SUCCESS;
+	mapi_repl->u.mapi_SetCollapseState.bookmark.cb = 0;
+	mapi_repl->u.mapi_SetCollapseState.bookmark.lpb = NULL;
+
+	handle = handles[mapi_req->handle_idx];
+	retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handle, &parent);
+	if (retval) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  handle (%x) not found: %x\n", handle, mapi_req->handle_idx);
+		goto end;
+	}
+
+	retval = mapi_handles_get_private_data(parent, &data);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		OC_DEBUG(5, "  handle data not found, idx = %x\n", mapi_req->handle_idx);
+		goto end;
+	}
+	object = (struct emsmdbp_object *) data;
+
+	/* Ensure object exists and is table type */
+	if (!object || (object->type != EMSMDBP_OBJECT_TABLE)) {
+		mapi_repl->error_code = MAPI_E_INVALID_OBJECT;
+		OC_DEBUG(5, "  no object or object is not a table\n");
+		goto end;
+	}
+
+	table = object->object.table;
+	if (!table->categories) {
+		mapi_repl->error_code = MAPI_E_NO_SUPPORT;
+		OC_DEBUG(5, "  table is not categorized\n");
+		goto end;
+	}
+	emsmdbp_object_table_categories_refresh(emsmdbp_ctx, object, false);
+
+	retval = emsmdbp_object_table_categories_set_state(table, &mapi_req->u.mapi_SetCollapseState.CollapseState);
+	if (retval) {
+		mapi_repl->error_code = retval;
+		goto end;
+	}
+
+	mapi_repl->error_code = emsmdbp_object_table_bookmark_create(emsmdbp_ctx, object, table->numerator,
+								     &mapi_repl->u.mapi_SetCollapseState.bookmark);
+
+end:
+	return MAPI_E_SUCCESS;
+}
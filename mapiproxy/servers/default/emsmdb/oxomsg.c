@@ -28,7 +28,15 @@
 #include "mapiproxy/libmapiserver/libmapiserver.h"
 #include "dcesrv_exchange_emsmdb.h"
 
-static void oxomsg_mapistore_handle_message_relocation(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *old_message_object)
+/**
+   \details Store a copy of a submitted message where its
+   PidTagTargetEntryId or PidTagSentMailSvrEID property points to,
+   usually the Sent Items folder
+
+   \param emsmdbp_ctx pointer to the emsmdb provider context
+   \param old_message_object the submitted message
+ */
+_PUBLIC_ void oxomsg_mapistore_handle_message_relocation(struct emsmdbp_context *emsmdbp_ctx, struct emsmdbp_object *old_message_object)
 {
 	TALLOC_CTX			*mem_ctx;
 	enum MAPITAGS			properties[] = { PidTagTargetEntryId, PidTagSentMailSvrEID };
@@ -144,7 +152,7 @@ static void oxomsg_mapistore_handle_message_relocation(struct emsmdbp_context *e
    \param mapi_repl pointer to the SubmitMessage EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -202,21 +210,17 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSubmitMessage(TALLOC_CTX *mem_ctx,
 		{
 			struct mapi_handles 	*handles;
 
-			for (handles = emsmdbp_ctx->handles_ctx->handles; handles; handles = handles->next) {
-				if (handles->parent_handle == rec->handle) {
-					struct emsmdbp_object	*object2 = NULL;
-					void			*private_data2;
-					struct mapi_handles	*rec2 = NULL;
-
-					retval = mapi_handles_search(emsmdbp_ctx->handles_ctx, handles->handle, &rec2);
-					if (retval) {
-						continue;
-					}
-					retval = mapi_handles_get_private_data(rec2, &private_data2);
-					object2 = (struct emsmdbp_object *)private_data2;
-					if (object2->type == EMSMDBP_OBJECT_STREAM) {
-						emsmdbp_object_stream_commit(object2);
-					}
+			for (handles = rec->children; handles; handles = handles->next_sibling) {
+				struct emsmdbp_object	*object2 = NULL;
+				void			*private_data2;
+
+				retval = mapi_handles_get_private_data(handles, &private_data2);
+				if (retval) {
+					continue;
+				}
+				object2 = (struct emsmdbp_object *)private_data2;
+				if (object2->type == EMSMDBP_OBJECT_STREAM) {
+					emsmdbp_object_stream_commit(object2);
 				}
 			}
 		}
@@ -225,6 +229,9 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSubmitMessage(TALLOC_CTX *mem_ctx,
 		contextID = emsmdbp_get_contextID(object);
 		flags = mapi_req->u.mapi_SubmitMessage.SubmitFlags;
 		owner = emsmdbp_get_owner(object);
+		if (emsmdbp_submit_queue(emsmdbp_ctx, object, flags)) {
+			break;
+		}
 		mapistore_message_submit(emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(object), object->backend_object, flags);
 		oxomsg_mapistore_handle_message_relocation(emsmdbp_ctx, object);
 		mapistore_indexing_record_add_mid(emsmdbp_ctx->mstore_ctx, contextID, owner, messageID);
@@ -232,8 +239,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSubmitMessage(TALLOC_CTX *mem_ctx,
 	}
 
  end:
-	*size += libmapiserver_RopSubmitMessage_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -247,7 +252,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSubmitMessage(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the SeSpooler EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the SetSpooler EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -271,8 +276,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetSpooler(TALLOC_CTX *mem_ctx,
 
 	/* TODO: actually implement related server-side behavior */
 
-	*size += libmapiserver_RopSetSpooler_size(NULL);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -286,7 +289,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopSetSpooler(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the AddressTypes EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the AddressTypes EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -354,7 +357,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetAddressTypes(TALLOC_CTX *mem_ctx,
 		mapi_repl->u.mapi_AddressTypes.transport[j].lppszA = talloc_asprintf(mem_ctx, "%s", addr_type);
 		mapi_repl->u.mapi_AddressTypes.size += (strlen(mapi_repl->u.mapi_AddressTypes.transport[j].lppszA) + 1);
 	}
-	*size += libmapiserver_RopGetAddressTypes_size(mapi_repl);
 
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
@@ -371,7 +373,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetAddressTypes(TALLOC_CTX *mem_ctx,
    \param mapi_repl pointer to the TransportSend EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -438,8 +440,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopTransportSend(TALLOC_CTX *mem_ctx,
 	response->NoPropertiesReturned = 1;
 
  end:
-	*size += libmapiserver_RopTransportSend_size(mapi_repl);
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -453,7 +453,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopTransportSend(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the OptionsData EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the OptionsData EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -484,8 +484,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOptionsData(TALLOC_CTX *mem_ctx,
 	mapi_repl->u.mapi_OptionsData.HelpFileSize = 0x0000;
 	mapi_repl->u.mapi_OptionsData.HelpFile = talloc_zero_array(mem_ctx, uint8_t, mapi_repl->u.mapi_OptionsData.HelpFileSize);
 
-	*size += libmapiserver_RopOptionsData_size(mapi_repl);
-
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return retval;
@@ -499,7 +497,7 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopOptionsData(TALLOC_CTX *mem_ctx,
    \param mapi_req pointer to the GetTransportFolder EcDoRpc_MAPI_REQ
    \param mapi_repl pointer to the GetTransportFolder EcDoRpc_MAPI_REPL
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -550,8 +548,6 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetTransportFolder(TALLOC_CTX *mem_ctx,
 	}
 
 end:
- 	*size += libmapiserver_RopGetTransportFolder_size(mapi_repl);
-
  	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
 	return MAPI_E_SUCCESS;
@@ -42,7 +42,7 @@
    \param mapi_repl pointer to the GetRulesTable EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -52,14 +52,17 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetRulesTable(TALLOC_CTX *mem_ctx,
 						  struct EcDoRpc_MAPI_REPL *mapi_repl,
 						  uint32_t *handles, uint16_t *size)
 {
-	enum MAPISTATUS		retval;
-	struct mapi_handles	*parent;
-	struct mapi_handles	*rec;
-	struct emsmdbp_object	*object;
-	void			*data = NULL;
-	uint32_t		handle;
-
-	OC_DEBUG(4, "exchange_emsmdb: [OXORULE] GetRulesTable (0x3f) -- stub\n");
+	enum MAPISTATUS			retval;
+	struct mapi_handles		*parent;
+	struct mapi_handles		*rec;
+	struct emsmdbp_object		*object;
+	struct emsmdbp_object_table	*table;
+	void				*data = NULL;
+	uint64_t			folderID;
+	char				*owner;
+	uint32_t			handle;
+
+	OC_DEBUG(4, "exchange_emsmdb: [OXORULE] GetRulesTable (0x3f)\n");
 
 	/* Sanity checks */
 	OPENCHANGE_RETVAL_IF(!emsmdbp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
@@ -101,16 +104,23 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopGetRulesTable(TALLOC_CTX *mem_ctx,
 	retval = mapi_handles_add(emsmdbp_ctx->handles_ctx, handle, &rec);
 	handles[mapi_repl->handle_idx] = rec->handle;
 
+	folderID = object->object.folder->folderID;
+	owner = emsmdbp_get_owner(object);
 	object = emsmdbp_object_table_init((TALLOC_CTX *)rec, emsmdbp_ctx, object);
 	if (object) {
 		retval = mapi_handles_set_private_data(rec, object);
-		/* rules tables are stub objects for now */
-		object->object.table->denominator = 0;
-		object->object.table->ulType = MAPISTORE_RULE_TABLE;
+		table = object->object.table;
+		table->ulType = MAPISTORE_RULE_TABLE;
+
+		/* Folders outside openchangedb have no rules */
+		retval = mapiproxy_rules_load(table, emsmdbp_ctx->oc_ctx, owner, folderID, &table->rules);
+		if (retval != MAPI_E_SUCCESS) {
+			OC_DEBUG(5, "  no rules for folder 0x%"PRIx64": %s\n", folderID, mapi_get_errstr(retval));
+			table->rules = NULL;
+		}
+		table->denominator = table->rules ? table->rules->count : 0;
 	}
 end:
-	*size += libmapiserver_RopGetRulesTable_size();
-
 	return MAPI_E_SUCCESS;
 }
 
@@ -127,7 +137,7 @@ end:
    \param mapi_repl pointer to the ModifyRules EcDoRpc_MAPI_REPL
    structure
    \param handles pointer to the MAPI handles array
-   \param size pointer to the mapi_response size to update
+   \param size pointer to the size of the response built so far
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
@@ -140,7 +150,10 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopModifyRules(TALLOC_CTX *mem_ctx,
 	enum MAPISTATUS		retval;
 	struct mapi_handles	*parent;
 	struct emsmdbp_object	*object;
+	struct mapiproxy_rules	*rules;
 	void			*data = NULL;
+	uint64_t		folderID;
+	char			*owner;
 	uint32_t		handle;
 
 	OC_DEBUG(4, "exchange_emsmdb: [OXORULE] ModifyRules (0x41)\n");
@@ -171,8 +184,27 @@ _PUBLIC_ enum MAPISTATUS EcDoRpc_RopModifyRules(TALLOC_CTX *mem_ctx,
 
 	handles[mapi_repl->handle_idx] = handles[mapi_req->handle_idx];
 
-end:
-	*size += libmapiserver_RopModifyRules_size();
+	/* Rules are stored with the folder record in openchangedb, where
+	 * the delivery path evaluates them */
+	folderID = object->object.folder->folderID;
+	owner = emsmdbp_get_owner(object);
+	retval = mapiproxy_rules_load(mem_ctx, emsmdbp_ctx->oc_ctx, owner, folderID, &rules);
+	if (retval != MAPI_E_SUCCESS) {
+		OC_DEBUG(5, "  unable to load the rules of folder 0x%"PRIx64": %s\n", folderID, mapi_get_errstr(retval));
+		mapi_repl->error_code = retval;
+		goto end;
+	}
 
+	retval = mapiproxy_rules_modify(rules, &mapi_req->u.mapi_ModifyRules);
+	if (retval == MAPI_E_SUCCESS) {
+		retval = mapiproxy_rules_save(emsmdbp_ctx->oc_ctx, owner, folderID, rules);
+	}
+	talloc_free(rules);
+	if (retval != MAPI_E_SUCCESS) {
+		OC_DEBUG(5, "  unable to modify the rules of folder 0x%"PRIx64": %s\n", folderID, mapi_get_errstr(retval));
+		mapi_repl->error_code = retval;
+	}
+
+end:
 	return MAPI_E_SUCCESS;
 }
@@ -25,24 +25,119 @@
    \brief OpenChange NSPI Server implementation
  */
 
+#include <time.h>
+
 #include "mapiproxy/dcesrv_mapiproxy.h"
 #include "mapiproxy/libmapiproxy/fault_util.h"
+#include "mapiproxy/util/ccan/htable/htable.h"
+#include "mapiproxy/util/ccan/hash/hash.h"
 #include "dcesrv_exchange_nsp.h"
 
+/* Most recently used first */
 static struct exchange_nsp_session	*nsp_session = NULL;
+static TALLOC_CTX			*nsp_session_ctx = NULL;
 static TDB_CONTEXT			*emsabp_tdb_ctx = NULL;
 
+/* Live sessions are indexed by their policy handle GUID, which every
+ * NSPI call provides */
+static size_t nsp_session_rehash(const void *e, void *unused);
+
+static struct htable	nsp_session_ht = HTABLE_INITIALIZER(nsp_session_ht, nsp_session_rehash, NULL);
+static uint32_t		nsp_session_count = 0;
+static uint32_t		nsp_session_max = 0;
+static int		nsp_session_idle_timeout = 0;
+
+static size_t nsp_session_hash(const struct GUID *uuid)
+{
+	return hash_any(uuid, sizeof (struct GUID), 0);
+}
+
+static size_t nsp_session_rehash(const void *e, void *unused)
+{
+	return nsp_session_hash(&((const struct exchange_nsp_session *)e)->uuid);
+}
+
+static bool nsp_session_cmp(const void *e, void *uuid)
+{
+	return GUID_equal((const struct GUID *)uuid, &((const struct exchange_nsp_session *)e)->uuid);
+}
+
 static struct exchange_nsp_session *dcesrv_find_nsp_session(struct GUID *uuid)
 {
-	struct exchange_nsp_session *session, *found_session = NULL;
+	struct exchange_nsp_session	*session;
 
-	for (session = nsp_session; !found_session && session; session = session->next) {
-		if (GUID_equal(uuid, &session->uuid)) {
-			found_session = session;
-		}
+	session = htable_get(&nsp_session_ht, nsp_session_hash(uuid), nsp_session_cmp, uuid);
+	if (session) {
+		DLIST_PROMOTE(nsp_session, session);
+		session->last_used = time(NULL);
+	}
+
+	return session;
+}
+
+/**
+   \details Register a newly created session in the session registry
+
+   \param session pointer to the session to register
+
+   \return true on success, otherwise false
+ */
+static bool dcesrv_add_nsp_session(struct exchange_nsp_session *session)
+{
+	if (!session || !session->session) return false;
+
+	if (!htable_add(&nsp_session_ht, nsp_session_rehash(session, NULL), session)) {
+		return false;
+	}
+	session->last_used = time(NULL);
+	DLIST_ADD(nsp_session, session);
+	nsp_session_count++;
+	mapiproxy_stats_add(MAPIPROXY_STATS_NSPI_SESSIONS, 1);
+
+	return true;
+}
+
+/**
+   \details Remove a session from the session registry. The session
+   itself is not released.
+
+   \param session pointer to the session to unregister
+ */
+static void dcesrv_remove_nsp_session(struct exchange_nsp_session *session)
+{
+	if (!session) return;
+
+	if (htable_del(&nsp_session_ht, nsp_session_rehash(session, NULL), session)) {
+		DLIST_REMOVE(nsp_session, session);
+		nsp_session_count--;
+		mapiproxy_stats_add(MAPIPROXY_STATS_NSPI_SESSIONS, -1);
 	}
+}
 
-	return found_session;
+/**
+   \details Release the least recently used sessions of clients which
+   did not unbind: the ones idle for exchange_nsp:session_idle_timeout
+   seconds, and as many as needed to bind a new session within
+   exchange_nsp:max_sessions
+ */
+static void dcesrv_expire_nsp_sessions(void)
+{
+	struct exchange_nsp_session	*session;
+	time_t				now;
+
+	now = time(NULL);
+	while ((session = DLIST_TAIL(nsp_session)) != NULL) {
+		if (!(nsp_session_max && nsp_session_count >= nsp_session_max) &&
+		    !(nsp_session_idle_timeout > 0 && now - session->last_used >= nsp_session_idle_timeout)) {
+			break;
+		}
+
+		OC_DEBUG(5, "Releasing nsp_session %p unused for %d seconds", session, (int)(now - session->last_used));
+		dcesrv_remove_nsp_session(session);
+		session->session->ref_count = 0;
+		mpm_session_release(session->session);
+		talloc_free(session);
+	}
 }
 
 static struct emsabp_context *dcesrv_find_emsabp_context(struct GUID *uuid)
@@ -120,6 +215,7 @@ static void dcesrv_NspiBind(struct dcesrv_call_state *dce_call,
 	DCESRV_NSP_RETURN_IF(r->in.pStat->CodePage == CP_UNICODE, r, MAPI_E_NO_SUPPORT, NULL);
 
 	/* Step 1. Initialize the emsabp context */
+	mapiproxy_stats_init(dce_call->conn->dce_ctx->lp_ctx);
 	emsabp_ctx = emsabp_init(dce_call->conn->dce_ctx->lp_ctx, emsabp_tdb_ctx);
 	if (!emsabp_ctx) {
 		OC_PANIC(false, ("[exchange_nsp] Unable to initialize emsabp context\n"));
@@ -163,19 +259,28 @@ static void dcesrv_NspiBind(struct dcesrv_call_state *dce_call,
 	} else {
 		OC_DEBUG(5, "Creating new session");
 
+		dcesrv_expire_nsp_sessions();
+
 		/* Step 6. Associate this emsabp context to the session */
-		session = talloc((TALLOC_CTX *)nsp_session, struct exchange_nsp_session);
+		session = talloc_zero(nsp_session_ctx, struct exchange_nsp_session);
 		DCESRV_NSP_RETURN_IF(!session, r, MAPI_E_NOT_ENOUGH_RESOURCES, emsabp_ctx);
 
-		session->session = mpm_session_init((TALLOC_CTX *)nsp_session, dce_call);
-		DCESRV_NSP_RETURN_IF(!session->session, r, MAPI_E_NOT_ENOUGH_RESOURCES, emsabp_ctx);
+		session->session = mpm_session_init(nsp_session_ctx, dce_call);
+		if (!session->session) {
+			talloc_free(session);
+			DCESRV_NSP_RETURN(r, MAPI_E_NOT_ENOUGH_RESOURCES, emsabp_ctx);
+		}
 
 		session->uuid = handle->wire_handle.uuid;
 
 		mpm_session_set_private_data(session->session, (void *) emsabp_ctx);
 		mpm_session_set_destructor(session->session, emsabp_destructor);
 
-		DLIST_ADD_END(nsp_session, session, struct exchange_nsp_session *);
+		if (!dcesrv_add_nsp_session(session)) {
+			talloc_free(session->session);
+			talloc_free(session);
+			DCESRV_NSP_RETURN(r, MAPI_E_NOT_ENOUGH_RESOURCES, emsabp_ctx);
+		}
 	}
 
 	DCESRV_NSP_RETURN(r, MAPI_E_SUCCESS, NULL);
@@ -218,7 +323,8 @@ static void dcesrv_NspiUnbind(struct dcesrv_call_state *dce_call,
 		session = dcesrv_find_nsp_session(&r->in.handle->uuid);
 		if (session) {
 			if (mpm_session_release(session->session)) {
-				DLIST_REMOVE(nsp_session, session);
+				dcesrv_remove_nsp_session(session);
+				talloc_free(session);
 				OC_DEBUG(5, "Session found and released\n");
 			} else {
 				OC_DEBUG(5, "Session found and ref_count decreased\n");
@@ -241,16 +347,17 @@ static void dcesrv_NspiUnbind(struct dcesrv_call_state *dce_call,
    In the case of an empty table it return 0 for both positions. The caller can discriminate between empty tables and one-row tables looking at the cValues of the PropertyTagArray_r
 
 
+   \param emsabp_ctx pointer to the EMSABP context
    \param pStat pointer to struct STAT which will be used to get the positions
    \param mids pointer to struct PropertyTagArray_r which contains the table as MIDs array
    \param[out] out_row pointer to the uint32_t which will cotaint the current row
    \param[out] out_last_row pointer to the uint32_t which will cotaint the last row in table
  */
-static void position_in_table(struct STAT *pStat,
+static void position_in_table(struct emsabp_context *emsabp_ctx,
+			      struct STAT *pStat,
 			      struct PropertyTagArray_r *mids,
 			      uint32_t *out_row, uint32_t *out_last_row)
 {
-	bool		found;
 	uint32_t	row;
 	uint32_t	last_row;
 
@@ -274,17 +381,7 @@ static void position_in_table(struct STAT *pStat,
 		else if (pStat->CurrentRec == MID_END_OF_TABLE) {
 			row = last_row;
 		} else {
-			found = false;
-			row = 0;
-			while (row <= last_row) {
-				if (mids->aulPropTag[row] == pStat->CurrentRec) {
-					found = true;
-					break;
-				} else {
-					row++;
-				}
-			}
-			if (!found) {
+			if (!emsabp_mids_find_row(emsabp_ctx, mids, pStat->CurrentRec, &row)) {
 				/* In this case the position is undefined. To avoid problems we will use first row */
 				row = 0;
 			}
@@ -298,16 +395,18 @@ static void position_in_table(struct STAT *pStat,
 /**
    \details This method does the main work of NspiUpdateStat. It is separated from dcesrv_NspiUpdateStat to be called from NspiQueryRows to update correctly the pStat struct. Also is called from NspiUpdateStat to avoid repeating code.
 
+   \param emsabp_ctx pointer to the EMSABP context
    \param[in,out] r pointer to the NspiUpdateStat request data
    \param mids pointer to struct PropertyTagArray_r which contains the table as MIDs array
 */
-static void dcesrv_do_NspiUpdateStat(struct NspiUpdateStat *r,
+static void dcesrv_do_NspiUpdateStat(struct emsabp_context *emsabp_ctx,
+				     struct NspiUpdateStat *r,
 				     struct PropertyTagArray_r *mids)
 {
 	enum MAPISTATUS			retval = MAPI_E_SUCCESS;
 	uint32_t			row, last_row;
 
-	position_in_table(r->in.pStat, mids, &row, &last_row);
+	position_in_table(emsabp_ctx, r->in.pStat, mids, &row, &last_row);
 
 	if (r->in.pStat->Delta != 0) {
 		/* Adjust row  by Delta */
@@ -389,7 +488,7 @@ static void dcesrv_NspiUpdateStat(struct dcesrv_call_state *dce_call, TALLOC_CTX
 	DCESRV_NSP_RETURN_IF(retval != MAPI_E_SUCCESS, r, retval, NULL);
 
 	/* Step 2. Do the update stat with the result */
-	dcesrv_do_NspiUpdateStat(r, mids);
+	dcesrv_do_NspiUpdateStat(emsabp_ctx, r, mids);
 }
 
 /**
@@ -413,6 +512,7 @@ static void dcesrv_do_NspiQueryRows(TALLOC_CTX *mem_ctx, struct NspiQueryRows *r
 	uint32_t			i, j;
 	struct NspiUpdateStat		r_UpdateStat;
 	bool				container_exists;
+	enum MAPISTATUS			*retvals;
 
 	/* Step 1. Sanity Checks (MS-NSPI Server Processing Rules) */
 	if (r->in.lpETable == NULL && r->in.pStat->ContainerID) {
@@ -455,7 +555,7 @@ static void dcesrv_do_NspiQueryRows(TALLOC_CTX *mem_ctx, struct NspiQueryRows *r
 		uint32_t		start_pos;
 		uint32_t		last_row;
 
-		position_in_table(r->in.pStat, mids, &start_pos, &last_row);
+		position_in_table(emsabp_ctx, r->in.pStat, mids, &start_pos, &last_row);
 		retval = emsabp_ab_container_enum(mem_ctx, emsabp_ctx,
 						  r->in.pStat->ContainerID, &ldb_res);
 		if (retval != MAPI_E_SUCCESS)  {
@@ -514,7 +614,7 @@ static void dcesrv_do_NspiQueryRows(TALLOC_CTX *mem_ctx, struct NspiQueryRows *r
 			r_UpdateStat.in.plDelta = NULL;
 			r_UpdateStat.in.pStat->TotalRecs = ldb_res->count;
 			r_UpdateStat.out.pStat = r->out.pStat;
-			dcesrv_do_NspiUpdateStat(&r_UpdateStat, mids);
+			dcesrv_do_NspiUpdateStat(emsabp_ctx, &r_UpdateStat, mids);
 			if (r_UpdateStat.out.result != MAPI_E_SUCCESS) {
 				/* Not clear in the spec what to do if updateStat fails, ignoring it and logging error for the moment */
 				OC_DEBUG(1, "NSPI UpdateStat after GetRows failed: %u\n", r_UpdateStat.out.result);
@@ -529,17 +629,23 @@ static void dcesrv_do_NspiQueryRows(TALLOC_CTX *mem_ctx, struct NspiQueryRows *r
 		if (r->in.pStat->NumPos < r->in.dwETableCount) {
 			pRows->cRows = r->in.dwETableCount - r->in.pStat->NumPos;
 			pRows->aRow = talloc_array(mem_ctx, struct PropertyRow_r, pRows->cRows);
-			if (pRows->aRow == NULL) {
+			retvals = talloc_array(mem_ctx, enum MAPISTATUS, pRows->cRows);
+			if (pRows->aRow == NULL || retvals == NULL) {
 				retval = MAPI_E_NOT_ENOUGH_MEMORY;
 				goto failure;
 			}
 
-			for (i = r->in.pStat->NumPos; i < r->in.dwETableCount; i++) {
-				retval = emsabp_fetch_attrs(mem_ctx, emsabp_ctx, &(pRows->aRow[j]), r->in.lpETable[i], r->in.dwFlags, pPropTags);
-				if (retval != MAPI_E_SUCCESS) {
+			retval = emsabp_fetch_attrs_rows(mem_ctx, emsabp_ctx, pRows->aRow,
+							 r->in.lpETable + r->in.pStat->NumPos, pRows->cRows,
+							 r->in.dwFlags, pPropTags, retvals);
+			if (retval != MAPI_E_SUCCESS) {
+				goto failure;
+			}
+
+			for (j = 0; j < pRows->cRows; j++) {
+				if (retvals[j] != MAPI_E_SUCCESS) {
 					dcesrv_make_ptyp_error_property_row(mem_ctx, pPropTags, &(pRows->aRow[j]));
 				}
-				j++;
 			}
 		}
 		r->out.pStat->CurrentRec = MID_END_OF_TABLE;
@@ -707,12 +813,9 @@ static void dcesrv_NspiSeekEntries(struct dcesrv_call_state *dce_call, TALLOC_CT
 	r->out.pStat->CurrentRec = MID_END_OF_TABLE;
 	r->out.pStat->NumPos = all_mids->cValues - 1;
 	r->out.pStat->TotalRecs = all_mids->cValues;
-	for (row = 0; row < all_mids->cValues; row++) {
-		if (all_mids->aulPropTag[row] == mids->aulPropTag[0]) {
-			r->out.pStat->CurrentRec = mids->aulPropTag[0];
-			r->out.pStat->NumPos = row;
-			break;
-		}
+	if (mids->cValues && emsabp_mids_find_row(emsabp_ctx, all_mids, mids->aulPropTag[0], &row)) {
+		r->out.pStat->CurrentRec = mids->aulPropTag[0];
+		r->out.pStat->NumPos = row;
 	}
 
 	/* now we need to populate the rows, if properties were requested */
@@ -792,6 +895,7 @@ static void dcesrv_NspiGetMatches(struct dcesrv_call_state *dce_call,
 	enum MAPISTATUS			retval;
 	struct emsabp_context		*emsabp_ctx = NULL;
 	struct PropertyTagArray_r	*ppOutMIds = NULL;
+	enum MAPISTATUS			*retvals;
 	uint32_t			i;
 
 	OC_DEBUG(3, "exchange_nsp: NspiGetMatches (0x5)\n");
@@ -831,7 +935,17 @@ static void dcesrv_NspiGetMatches(struct dcesrv_call_state *dce_call,
 	ppOutMIds->cValues = 0;
 	ppOutMIds->aulPropTag = NULL;
 
-	retval = emsabp_search(mem_ctx, emsabp_ctx, ppOutMIds, r->in.Filter, r->in.pStat, r->in.ulRequested);
+	/* Without filter, the explicit table of a distribution list is
+	   made of its members ([MS-OXNSPI] Section 3.1.4.1.10) */
+	retval = MAPI_E_NOT_FOUND;
+	if (!r->in.Filter && r->in.pStat->CurrentRec != MID_BEGINNING_OF_TABLE &&
+	    r->in.pStat->CurrentRec != MID_CURRENT && r->in.pStat->CurrentRec != MID_END_OF_TABLE) {
+		retval = emsabp_search_members(mem_ctx, emsabp_ctx, ppOutMIds, r->in.pStat->CurrentRec,
+					       r->in.ulRequested);
+	}
+	if (retval == MAPI_E_NOT_FOUND) {
+		retval = emsabp_search(mem_ctx, emsabp_ctx, ppOutMIds, r->in.Filter, r->in.pStat, r->in.ulRequested);
+	}
 	if (retval != MAPI_E_SUCCESS) {
 	failure:
 		memcpy(r->out.pStat, r->in.pStat, sizeof(struct STAT));
@@ -849,11 +963,20 @@ static void dcesrv_NspiGetMatches(struct dcesrv_call_state *dce_call,
 	r->out.ppRows[0]->cRows = ppOutMIds->cValues;
 	r->out.ppRows[0]->aRow = talloc_array(mem_ctx, struct PropertyRow_r, ppOutMIds->cValues);
 
+	retvals = talloc_array(mem_ctx, enum MAPISTATUS, ppOutMIds->cValues);
+	if (!retvals) {
+		retval = MAPI_E_NOT_ENOUGH_MEMORY;
+		goto failure;
+	}
+	retval = emsabp_fetch_attrs_rows(mem_ctx, emsabp_ctx, r->out.ppRows[0]->aRow,
+					 ppOutMIds->aulPropTag, ppOutMIds->cValues,
+					 fEphID, r->in.pPropTags, retvals);
+	if (retval) goto failure;
+
 	for (i = 0; i < ppOutMIds->cValues; i++) {
-		retval = emsabp_fetch_attrs(mem_ctx, emsabp_ctx, &(r->out.ppRows[0]->aRow[i]),
-					    ppOutMIds->aulPropTag[i], fEphID, r->in.pPropTags);
-		if (retval) {
+		if (retvals[i]) {
 			OC_DEBUG(5, "failure looking up value %d\n", i);
+			retval = retvals[i];
 			goto failure;
 		}
 	}
@@ -1060,8 +1183,42 @@ static void dcesrv_NspiCompareMIds(struct dcesrv_call_state *dce_call,
 					      TALLOC_CTX *mem_ctx,
 					      struct NspiCompareMIds *r)
 {
-	OC_DEBUG(3, "exchange_nsp: NspiCompareMIds (0xA) not implemented");
-	DCESRV_NSP_RETURN(r, DCERPC_FAULT_OP_RNG_ERROR, NULL);
+	enum MAPISTATUS			retval;
+	struct emsabp_context		*emsabp_ctx = NULL;
+	struct PropertyTagArray_r	*mids;
+	bool				container_exists;
+	uint32_t			row1, row2;
+
+	OC_DEBUG(3, "exchange_nsp: NspiCompareMIds (0xA)");
+	/* Ensure incoming user is authenticated */
+	if (!dcesrv_call_authenticated(dce_call)) {
+		OC_DEBUG(1, "No challenge requested by client, cannot authenticate\n");
+		DCESRV_NSP_RETURN(r, MAPI_E_LOGON_FAILED, NULL);
+	}
+
+	/* Step 0. Sanity checks from Server Processing Rules */
+	DCESRV_NSP_RETURN_IF(r->in.pStat->CodePage == CP_UNICODE, r, MAPI_E_NO_SUPPORT, NULL);
+
+	emsabp_ctx = dcesrv_find_emsabp_context(&r->in.handle->uuid);
+	DCESRV_NSP_RETURN_IF(!emsabp_ctx, r, MAPI_E_CALL_FAILED, NULL);
+
+	if (r->in.pStat->ContainerID) {
+		container_exists = emsabp_tdb_lookup_MId(emsabp_ctx->tdb_ctx, r->in.pStat->ContainerID);
+		DCESRV_NSP_RETURN_IF(!container_exists, r, MAPI_E_INVALID_BOOKMARK, NULL);
+	}
+
+	/* Step 1. Retrieve the table the STAT describes */
+	mids = talloc_zero(mem_ctx, struct PropertyTagArray_r);
+	DCESRV_NSP_RETURN_IF(!mids, r, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	retval = emsabp_search(mem_ctx, emsabp_ctx, mids, NULL, r->in.pStat, 0);
+	DCESRV_NSP_RETURN_IF(retval != MAPI_E_SUCCESS, r, retval, NULL);
+
+	/* Step 2. Compare the positions of both MIds */
+	DCESRV_NSP_RETURN_IF(!emsabp_mids_find_row(emsabp_ctx, mids, r->in.MId1, &row1), r, MAPI_E_NOT_FOUND, NULL);
+	DCESRV_NSP_RETURN_IF(!emsabp_mids_find_row(emsabp_ctx, mids, r->in.MId2, &row2), r, MAPI_E_NOT_FOUND, NULL);
+	*r->out.plResult = (int32_t) row1 - (int32_t) row2;
+
+	DCESRV_NSP_RETURN(r, MAPI_E_SUCCESS, NULL);
 }
 
 
@@ -1262,6 +1419,65 @@ static void dcesrv_NspiGetIDsFromNames(struct dcesrv_call_state *dce_call,
 }
 
 
+/**
+   \details Resolve a name searching the directory for entries of the
+   container having one of their ANR attributes starting with the name
+
+   \param mem_ctx pointer to the memory context
+   \param emsabp_ctx pointer to the EMSABP context
+   \param filter_search the LDAP filter of the container
+   \param name the name to resolve
+   \param MIdStatus pointer to the resolution status to return
+   \param ldb_msgp pointer on pointer to the resolved entry
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS dcesrv_nspi_anr_search(TALLOC_CTX *mem_ctx,
+					      struct emsabp_context *emsabp_ctx,
+					      const char *filter_search,
+					      const char *name,
+					      uint32_t *MIdStatus,
+					      struct ldb_message **ldb_msgp)
+{
+	struct ldb_result	*ldb_res;
+	const char * const	recipient_attrs[] = { "*", NULL };
+	char			*filter;
+	char			*attr_filter;
+	int			ret;
+	int			j;
+
+	/* Build search filter */
+	filter = talloc_strdup(mem_ctx, "");
+	OPENCHANGE_RETVAL_IF(!filter, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	for (j = 0; emsabp_anr_attrs[j]; j++) {
+		attr_filter = talloc_asprintf(mem_ctx, "(%s=%s*)", emsabp_anr_attrs[j],
+					      ldb_binary_encode_string(mem_ctx, name));
+		OPENCHANGE_RETVAL_IF(!attr_filter, MAPI_E_NOT_ENOUGH_MEMORY, filter);
+		filter = talloc_strdup_append(filter, attr_filter);
+		talloc_free(attr_filter);
+		OPENCHANGE_RETVAL_IF(!filter, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	}
+
+	/* Search AD */
+	ret = ldb_search(emsabp_ctx->samdb_ctx, mem_ctx, &ldb_res,
+			 ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
+			 LDB_SCOPE_SUBTREE, recipient_attrs, "(&%s(|%s))", filter_search, filter);
+	talloc_free(filter);
+
+	/* Determine name resolution status */
+	if (ret != LDB_SUCCESS || ldb_res->count == 0) {
+		*MIdStatus = MAPI_UNRESOLVED;
+	} else if (ldb_res->count > 1) {
+		*MIdStatus = MAPI_AMBIGUOUS;
+	} else {
+		*MIdStatus = MAPI_RESOLVED;
+		*ldb_msgp = ldb_res->msgs[0];
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details common code called by NspiResolveNames and NspiResolveNamesW functions
             NspiResolveNames should before copy the values of its struct NspiResolveNames to a
@@ -1290,18 +1506,8 @@ static void dcesrv_do_NspiResolveNamesW(struct dcesrv_call_state *dce_call,
 	struct PropertyTagArray_r	*pMIds = NULL;
 	struct PropertyRowSet_r		*pRows = NULL;
 	struct StringsArrayW_r		*paWStr;
+	struct emsabp_snapshot		*snapshot = NULL;
 	uint32_t			i;
-	int				ret;
-	const char * const		recipient_attrs[] = { "*", NULL };
-	/* Attributes for ANR search */
-	const char * const		search_attr[] = { "mailNickName", "mail", "name",
-							  "displayName", "givenName", "sn",
-							  "sAMAccountName",
-							  "legacyExchangeDN",
-							  "physicalDeliveryOfficeName"};
-	/* We do not use proxyAddresses attribute for search because we do not expect the user to type in the protocol.
-	   We do not use RDN attribute because it seems samba lack support for it.
-	   However in user objects RDN should be the same than name, so this case is covered. */
 
 	/* Step 0. Ensure incoming user is authenticated */
 	if (!dcesrv_call_authenticated(dce_call)) {
@@ -1369,57 +1575,36 @@ static void dcesrv_do_NspiResolveNamesW(struct dcesrv_call_state *dce_call,
 		goto failure;
 	}
 
-	/* Step 2. Fetch AB container records */
+	/* Step 2. Resolve names against the container snapshot, if any */
+	if (emsabp_snapshot_enabled(emsabp_ctx)) {
+		retval = emsabp_snapshot_get(mem_ctx, emsabp_ctx, filter_search, true, &snapshot);
+		if (retval != MAPI_E_SUCCESS) {
+			snapshot = NULL;
+		}
+	}
+
+	/* Step 3. Fetch AB container records */
 	for (i = 0; i < paWStr->Count; i++) {
-		struct ldb_result	*ldb_res;
-		char			*filter;
-		int			j;
+		struct ldb_message	*ldb_msg = NULL;
 
-		filter = talloc_strdup(mem_ctx, "");
-		if (!filter) {
-			retval = MAPI_E_NOT_ENOUGH_MEMORY;
-			goto failure;
-		}
-		/* Build search filter */
-		for (j = 0; j < ARRAY_SIZE(search_attr); j++) {
-			char *attr_filter = talloc_asprintf(mem_ctx, "(%s=%s*)", search_attr[j],
-							    ldb_binary_encode_string(mem_ctx, paWStr->Strings[i]));
-			if (!attr_filter) {
-				retval = MAPI_E_NOT_ENOUGH_MEMORY;
-				goto failure;
-			}
-			filter = talloc_strdup_append(filter, attr_filter);
-			if (!filter) {
-				retval = MAPI_E_NOT_ENOUGH_MEMORY;
-				goto failure;
-			}
-			talloc_free(attr_filter);
+		if (snapshot) {
+			retval = emsabp_snapshot_anr(snapshot, paWStr->Strings[i], &pMIds->aulPropTag[i], &ldb_msg);
+		} else {
+			retval = dcesrv_nspi_anr_search(mem_ctx, emsabp_ctx, filter_search, paWStr->Strings[i],
+							&pMIds->aulPropTag[i], &ldb_msg);
 		}
-
-		/* Search AD */
-		filter = talloc_asprintf(mem_ctx, "(&%s(|%s))", filter_search, filter);
-		if (!filter) {
-			retval = MAPI_E_NOT_ENOUGH_MEMORY;
+		if (retval != MAPI_E_SUCCESS) {
 			goto failure;
 		}
 
-		ret = ldb_search(emsabp_ctx->samdb_ctx, mem_ctx, &ldb_res,
-				 ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
-				 LDB_SCOPE_SUBTREE, recipient_attrs, "%s", filter);
-
-		/* Determine name resolution status and fetch object upon success */
-		if (ret != LDB_SUCCESS || ldb_res->count == 0) {
-			pMIds->aulPropTag[i] = MAPI_UNRESOLVED;
-		} else if (ldb_res->count > 1) {
-			pMIds->aulPropTag[i] = MAPI_AMBIGUOUS;
-		} else {
-			pMIds->aulPropTag[i] = MAPI_RESOLVED;
+		/* Fetch object upon success */
+		if (pMIds->aulPropTag[i] == MAPI_RESOLVED) {
 			/* The standard says that we must have a call to NspiQueryRows to fill the rows.
 			   However with our actual implementation it would imply extract the dn, use it to
 			   get the mid and then call to QueryRows, where the element data would be fetched again.
 			   So for efficiency we will build the row here, with the data we already have */
 			retval = emsabp_fetch_attrs_from_msg(mem_ctx, emsabp_ctx, &pRows->aRow[pRows->cRows],
-							     ldb_res->msgs[0], 0, 0, pPropTags);
+							     ldb_msg, 0, 0, pPropTags);
 			if (retval != MAPI_E_SUCCESS) {
 				OC_DEBUG(5, "[nspi] emsabp_fetch_attrs_from_msg failed");
 				goto failure;
@@ -1526,6 +1711,10 @@ static NTSTATUS dcesrv_exchange_nsp_dispatch(struct dcesrv_call_state *dce_call,
 	if (!table) return NT_STATUS_UNSUCCESSFUL;
 	if (table->name && strcmp(table->name, NDR_EXCHANGE_NSP_NAME)) return NT_STATUS_UNSUCCESSFUL;
 
+	mapiproxy_stats_add(MAPIPROXY_STATS_NSPI_CALLS, 1);
+
+	/* samdb and openchangedb are shared with the emsmdb workers */
+	mapiproxy_server_lock();
 	switch (opnum) {
 	case NDR_NSPIBIND:
 		dcesrv_NspiBind(dce_call, mem_ctx, (struct NspiBind *)r);
@@ -1591,6 +1780,7 @@ static NTSTATUS dcesrv_exchange_nsp_dispatch(struct dcesrv_call_state *dce_call,
 		dcesrv_NspiResolveNamesW(dce_call, mem_ctx, (struct NspiResolveNamesW *)r);
 		break;
 	}
+	mapiproxy_server_unlock();
 
 	return NT_STATUS_OK;
 }
@@ -1605,11 +1795,16 @@ static NTSTATUS dcesrv_exchange_nsp_dispatch(struct dcesrv_call_state *dce_call,
  */
 static NTSTATUS dcesrv_exchange_nsp_init(struct dcesrv_context *dce_ctx)
 {
+	struct emsabp_context	*emsabp_ctx;
+	struct ldb_result	*res;
+	TALLOC_CTX		*mem_ctx;
+
 	OC_DEBUG(0, "dcesrv_exchange_nsp_init");
 	/* Initialize exchange_nsp session */
-	nsp_session = talloc_zero(dce_ctx, struct exchange_nsp_session);
-	if (!nsp_session) return NT_STATUS_NO_MEMORY;
-	nsp_session->session = NULL;
+	nsp_session_ctx = talloc_named(dce_ctx, 0, "exchange_nsp_session");
+	if (!nsp_session_ctx) return NT_STATUS_NO_MEMORY;
+	nsp_session_max = lpcfg_parm_int(dce_ctx->lp_ctx, NULL, "exchange_nsp", "max_sessions", 0);
+	nsp_session_idle_timeout = lpcfg_parm_int(dce_ctx->lp_ctx, NULL, "exchange_nsp", "session_idle_timeout", 0);
 
 	/* Open a read-write pointer on the EMSABP TDB database */
 	emsabp_tdb_ctx = emsabp_tdb_init((TALLOC_CTX *)dce_ctx, dce_ctx->lp_ctx);
@@ -1618,6 +1813,20 @@ static NTSTATUS dcesrv_exchange_nsp_init(struct dcesrv_context *dce_ctx)
 		return NT_STATUS_INTERNAL_ERROR;
 	}
 
+	/* Build the snapshot of the Global Address List before the first
+	 * client connects */
+	if (lpcfg_parm_bool(dce_ctx->lp_ctx, NULL, "exchange_nsp", "warmup", false)) {
+		emsabp_ctx = emsabp_init(dce_ctx->lp_ctx, emsabp_tdb_ctx);
+		if (emsabp_ctx && emsabp_snapshot_enabled(emsabp_ctx)) {
+			mem_ctx = talloc_named(NULL, 0, "dcesrv_exchange_nsp_init");
+			if (emsabp_ab_container_enum(mem_ctx, emsabp_ctx, 0, &res) != MAPI_E_SUCCESS) {
+				OC_DEBUG(1, "[exchange_nsp] Unable to build the Global Address List snapshot");
+			}
+			talloc_free(mem_ctx);
+		}
+		emsabp_destructor(emsabp_ctx);
+	}
+
 	return NT_STATUS_OK;
 }
 
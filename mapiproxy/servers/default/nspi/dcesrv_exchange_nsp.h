@@ -49,11 +49,50 @@ struct emsabp_context {
 	TDB_CONTEXT		*tdb_ctx;
 	TDB_CONTEXT		*ttdb_ctx;
 	TALLOC_CTX		*mem_ctx;
+	struct emsabp_snapshot	*mids_snapshot;
+	uint32_t		*mids;
+	struct emsabp_mid_row	*mids_index;
+	uint32_t		mids_count;
+};
+
+/**
+   Position of a MId in the cached snapshot table, sorted by MId
+ */
+struct emsabp_mid_row {
+	uint32_t		MId;
+	uint32_t		row;
+};
+
+/**
+   Snapshot index entry, keyed by DN or by lower case ANR value
+ */
+struct emsabp_snapshot_entry {
+	const char		*key;
+	struct ldb_message	*msg;
+};
+
+/**
+   Address Book search snapshot, see emsabp_snapshot.c
+ */
+struct emsabp_snapshot {
+	char				*filter;
+	bool				sorted;
+	struct ldb_result		*res;
+	struct emsabp_snapshot_entry	*by_dn;
+	uint32_t			by_dn_count;
+	bool				anr_indexed;
+	struct emsabp_snapshot_entry	*anr;
+	uint32_t			anr_count;
+	time_t				expires;
+	uint64_t			seq_num;	/* directory sequence number it was built at */
+	struct emsabp_snapshot		*prev;
+	struct emsabp_snapshot		*next;
 };
 
 struct exchange_nsp_session {
 	struct mpm_session		*session;
 	struct GUID			uuid;
+	time_t				last_used;
 	struct exchange_nsp_session	*prev;
 	struct exchange_nsp_session	*next;
 };
@@ -105,6 +144,10 @@ struct EphemeralEntryID {
 #define	EMSABP_TDB_MID_START		0x1b28
 #define	EMSABP_TDB_TMP_MID_START	0x5000
 #define	EMSABP_TDB_DATA_REC		"MId_index"
+#define	EMSABP_TDB_MID_DN_PREFIX	"MId:"
+#define	EMSABP_TDB_MID_DN_REC		EMSABP_TDB_MID_DN_PREFIX "0x%x"
+
+#define	EMSABP_SNAPSHOT_TTL		300
 
 #define DCESRV_NSP_RETURN_IF(x,r,c,ctx)		\
 do {						\
@@ -130,7 +173,6 @@ do {					\
 __BEGIN_DECLS
 
 NTSTATUS		samba_init_module(void);
-struct ldb_context	*samdb_connect_url(TALLOC_CTX *, struct tevent_context *, struct loadparm_context *, struct auth_session_info *, unsigned int, const char *);
 const struct GUID	*samdb_ntds_objectGUID(struct ldb_context *);
 
 /* definitions from emsabp.c */
@@ -150,15 +192,28 @@ enum MAPISTATUS		emsabp_get_CreationTemplatesTable(TALLOC_CTX *, struct emsabp_c
 void			*emsabp_query(TALLOC_CTX *, struct emsabp_context *, struct ldb_message *, uint32_t, uint32_t, uint32_t);
 enum MAPISTATUS		emsabp_fetch_attrs_from_msg(TALLOC_CTX *, struct emsabp_context *, struct PropertyRow_r *, struct ldb_message *, uint32_t, uint32_t, struct SPropTagArray *);
 enum MAPISTATUS		emsabp_fetch_attrs(TALLOC_CTX *, struct emsabp_context *, struct PropertyRow_r *, uint32_t, uint32_t, struct SPropTagArray *);
+enum MAPISTATUS		emsabp_fetch_attrs_rows(TALLOC_CTX *, struct emsabp_context *, struct PropertyRow_r *, const uint32_t *, uint32_t, uint32_t,
+						struct SPropTagArray *, enum MAPISTATUS *);
 enum MAPISTATUS		emsabp_table_fetch_attrs(TALLOC_CTX *, struct emsabp_context *, struct PropertyRow_r *, uint32_t, struct PermanentEntryID *, 
 						 struct PermanentEntryID *, struct ldb_message *, bool);
 enum MAPISTATUS		emsabp_search(TALLOC_CTX *, struct emsabp_context *, struct PropertyTagArray_r *, struct Restriction_r *, struct STAT *, uint32_t);
+enum MAPISTATUS		emsabp_search_members(TALLOC_CTX *, struct emsabp_context *, struct PropertyTagArray_r *, uint32_t, uint32_t);
+bool			emsabp_mids_find_row(struct emsabp_context *, struct PropertyTagArray_r *, uint32_t, uint32_t *);
 enum MAPISTATUS		emsabp_search_dn(struct emsabp_context *, const char *, struct ldb_message **);
 enum MAPISTATUS		emsabp_search_legacyExchangeDN(struct emsabp_context *, const char *, struct ldb_message **, bool *);
 enum MAPISTATUS		emsabp_ab_fetch_filter(TALLOC_CTX *, struct emsabp_context *, uint32_t, char **);
 enum MAPISTATUS		emsabp_ab_container_enum(TALLOC_CTX *, struct emsabp_context *, uint32_t, struct ldb_result **);
 
 
+/* definitions from emsabp_snapshot.c */
+bool			emsabp_snapshot_enabled(struct emsabp_context *);
+enum MAPISTATUS		emsabp_snapshot_get(TALLOC_CTX *, struct emsabp_context *, const char *, bool, struct emsabp_snapshot **);
+struct ldb_message	*emsabp_snapshot_find_dn(struct emsabp_snapshot *, const char *);
+struct ldb_message	*emsabp_snapshot_lookup_dn(TALLOC_CTX *, const char *);
+enum MAPISTATUS		emsabp_snapshot_anr(struct emsabp_snapshot *, const char *, uint32_t *, struct ldb_message **);
+
+extern const char * const emsabp_anr_attrs[];
+
 /* definitions from emsabp_tdb.c */
 TDB_CONTEXT		*emsabp_tdb_init(TALLOC_CTX *, struct loadparm_context *);
 enum MAPISTATUS		emsabp_tdb_close(TDB_CONTEXT *);
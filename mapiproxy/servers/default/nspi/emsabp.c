@@ -32,50 +32,6 @@
 #include "dcesrv_exchange_nsp.h"
 #include "ldb.h"
 
-/* Expose samdb_connect prototype */
-struct ldb_context *samdb_connect(TALLOC_CTX *, struct tevent_context *,
-				  struct loadparm_context *,
-				  struct auth_session_info *,
-				  unsigned int);
-
-/* Single connection to samdb */
-static struct ldb_context *samdb_ctx = NULL;
-
-/**
-   \details Initialize ldb_context to samdb, creates one for all emsabp
-   contexts
-
-   \param lp_ctx pointer to the loadparm context
- */
-static struct ldb_context *samdb_init(struct loadparm_context *lp_ctx)
-{
-	TALLOC_CTX		*mem_ctx;
-	struct tevent_context	*ev;
-	const char		*samdb_url;
-
-	if (samdb_ctx) return samdb_ctx;
-
-	mem_ctx = talloc_autofree_context();
-	ev = tevent_context_init(mem_ctx);
-	if (!ev) {
-		OC_PANIC(false, ("Fail to initialize tevent_context\n"));
-		return NULL;
-	}
-	tevent_loop_allow_nesting(ev);
-
-	/* Retrieve samdb url (local or external) */
-	samdb_url = lpcfg_parm_string(lp_ctx, NULL, "dcerpc_mapiproxy", "samdb_url");
-
-	if (!samdb_url) {
-		samdb_ctx = samdb_connect(mem_ctx, ev, lp_ctx, system_session(lp_ctx), 0);
-	} else {
-		samdb_ctx = samdb_connect_url(mem_ctx, ev, lp_ctx, system_session(lp_ctx),
-					      LDB_FLG_RECONNECT, samdb_url);
-	}
-
-	return samdb_ctx;
-}
-
 /**
    \details Initialize the EMSABP context and open connections to
    Samba databases.
@@ -107,7 +63,7 @@ _PUBLIC_ struct emsabp_context *emsabp_init(struct loadparm_context *lp_ctx,
 	/* Save a pointer to the loadparm context */
 	emsabp_ctx->lp_ctx = lp_ctx;
 
-	emsabp_ctx->samdb_ctx = samdb_init(lp_ctx);
+	emsabp_ctx->samdb_ctx = mapiproxy_server_samdb_init(lp_ctx);
 	if (!emsabp_ctx->samdb_ctx) {
 		talloc_free(mem_ctx);
 		OC_DEBUG(0, "[nspi] Connection to \"sam.ldb\" failed");
@@ -708,80 +664,216 @@ _PUBLIC_ enum MAPISTATUS emsabp_fetch_attrs_from_msg(TALLOC_CTX *mem_ctx,
 }
 
 /**
-   \details Builds the SRow array entry for the specified MId.
+   \details Build the list of LDB attributes needed to compute the
+   requested properties
 
-   The function retrieves the DN associated to the specified MId
-   within its on-memory TDB database. It next fetches the LDB record
-   matching the DN and finally retrieve the requested properties for
-   this record.
+   \param mem_ctx pointer to the memory context
+   \param pPropTags pointer to the property tags array
+
+   \return NULL terminated attributes array on success, otherwise NULL
+ */
+static const char **emsabp_fetch_attrs_list(TALLOC_CTX *mem_ctx, struct SPropTagArray *pPropTags)
+{
+	const char	**attrs;
+	const char	*attribute;
+	uint32_t	count;
+	uint32_t	i, j;
+
+	attrs = talloc_zero_array(mem_ctx, const char *, pPropTags->cValues + 4);
+	if (!attrs) return NULL;
+
+	/* Attributes used by emsabp_query for computed properties */
+	attrs[0] = "distinguishedName";
+	attrs[1] = "objectGUID";
+	attrs[2] = emsabp_property_get_attribute(PidTagEmailAddress);
+	count = 3;
+
+	for (i = 0; i < pPropTags->cValues; i++) {
+		attribute = emsabp_property_get_attribute(pPropTags->aulPropTag[i]);
+		if (!attribute) continue;
+		for (j = 0; j < count; j++) {
+			if (!strcasecmp(attrs[j], attribute)) break;
+		}
+		if (j == count) {
+			attrs[count++] = attribute;
+		}
+	}
+	attrs[count] = NULL;
+
+	return attrs;
+}
+
+
+/**
+   \details Builds the SRow array entries for a list of MIds.
+
+   The function retrieves the DN associated to each MId within the
+   TDB databases. Records that are not part of an address book
+   snapshot are fetched with a single LDB search, limited to the
+   attributes of the requested properties, and rows are finally built
+   in MIds order.
 
    \param mem_ctx pointer to the memory context
    \param emsabp_ctx pointer to the EMSABP context
-   \param aRow pointer to the SRow structure where results will be
-   stored
-   \param MId MId to fetch properties for
+   \param aRows pointer to the array of count SRow structures where
+   results will be stored
+   \param MIds pointer to the array of MIds to fetch properties for
+   \param count number of MIds
    \param dwFlags bit flags specifying whether or not the server must
    return the values of the property PidTagEntryId in the Ephemeral
    or Permanent Entry ID format
    \param pPropTags pointer to the property tags array
+   \param retvals pointer to the array of count MAPI status where the
+   result of each row is returned
 
-   \note We currently assume records are users.ldb
+   \note Rows whose status is not MAPI_E_SUCCESS are left unset.
 
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
-_PUBLIC_ enum MAPISTATUS emsabp_fetch_attrs(TALLOC_CTX *mem_ctx, struct emsabp_context *emsabp_ctx,
-					    struct PropertyRow_r *aRow, uint32_t MId, uint32_t dwFlags,
-					    struct SPropTagArray *pPropTags)
+_PUBLIC_ enum MAPISTATUS emsabp_fetch_attrs_rows(TALLOC_CTX *mem_ctx, struct emsabp_context *emsabp_ctx,
+						 struct PropertyRow_r *aRows, const uint32_t *MIds, uint32_t count,
+						 uint32_t dwFlags, struct SPropTagArray *pPropTags,
+						 enum MAPISTATUS *retvals)
 {
+	TALLOC_CTX		*local_mem_ctx;
 	enum MAPISTATUS		retval;
-	char			*dn;
-	const char * const	recipient_attrs[] = { "*", NULL };
+	char			**dns;
+	char			*filter;
+	const char		**attrs;
+	const char		*dn;
+	struct ldb_message	**msgs;
 	struct ldb_result	*res = NULL;
-	struct ldb_dn		*ldb_dn = NULL;
+	struct ldb_dn		*ldb_dn;
+	uint32_t		missing = 0;
+	uint32_t		i, j;
 	int			ret;
-	uint32_t		ulPropTag;
-	void			*data;
-	int			i;
 
-	/* Step 0. Try to Retrieve the dn associated to the MId first from temp TDB (users) */
-	retval = emsabp_tdb_fetch_dn_from_MId(mem_ctx, emsabp_ctx->ttdb_ctx, MId, &dn);
-	if (retval != MAPI_E_SUCCESS) {
-		/* If it fails try to retrieve it from the on-disk TDB database (conf) */
-		retval = emsabp_tdb_fetch_dn_from_MId(mem_ctx, emsabp_ctx->tdb_ctx, MId, &dn);
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsabp_ctx, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!aRows || !MIds || !pPropTags || !retvals, MAPI_E_INVALID_PARAMETER, NULL);
+	if (!count) return MAPI_E_SUCCESS;
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	dns = talloc_zero_array(local_mem_ctx, char *, count);
+	OPENCHANGE_RETVAL_IF(!dns, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+	msgs = talloc_zero_array(local_mem_ctx, struct ldb_message *, count);
+	OPENCHANGE_RETVAL_IF(!msgs, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+
+	/* Step 1. Retrieve the dn associated to each MId, first from temp TDB (users),
+	 * then from the on-disk TDB database (conf) */
+	for (i = 0; i < count; i++) {
+		retvals[i] = MAPI_E_SUCCESS;
+		retval = emsabp_tdb_fetch_dn_from_MId(local_mem_ctx, emsabp_ctx->ttdb_ctx, MIds[i], &dns[i]);
+		if (retval != MAPI_E_SUCCESS) {
+			retval = emsabp_tdb_fetch_dn_from_MId(local_mem_ctx, emsabp_ctx->tdb_ctx, MIds[i], &dns[i]);
+		}
+		if (retval != MAPI_E_SUCCESS) {
+			retvals[i] = MAPI_E_INVALID_BOOKMARK;
+			continue;
+		}
+
+		/* Records from the address book snapshots are complete */
+		msgs[i] = emsabp_snapshot_lookup_dn(mem_ctx, dns[i]);
+		if (!msgs[i]) {
+			missing++;
+		}
 	}
-	OPENCHANGE_RETVAL_IF(retval, MAPI_E_INVALID_BOOKMARK, NULL);
 
-	/* Step 1. Fetch the LDB record */
-	ldb_dn = ldb_dn_new(mem_ctx, emsabp_ctx->samdb_ctx, dn);
-	OPENCHANGE_RETVAL_IF(!ldb_dn_validate(ldb_dn), MAPI_E_CORRUPT_STORE, NULL);
+	/* Step 2. Fetch the remaining LDB records within a single search */
+	if (missing) {
+		attrs = emsabp_fetch_attrs_list(local_mem_ctx, pPropTags);
+		OPENCHANGE_RETVAL_IF(!attrs, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
 
-	ret = ldb_search(emsabp_ctx->samdb_ctx, emsabp_ctx->mem_ctx, &res, ldb_dn, LDB_SCOPE_BASE,
-			 recipient_attrs, NULL);
-	OPENCHANGE_RETVAL_IF(ret != LDB_SUCCESS || !res->count || res->count != 1, MAPI_E_CORRUPT_STORE, NULL);
+		filter = talloc_strdup(local_mem_ctx, "(|");
+		for (i = 0; filter && i < count; i++) {
+			if (!dns[i] || msgs[i]) continue;
+			filter = talloc_asprintf_append_buffer(filter, "(distinguishedName=%s)",
+							       ldb_binary_encode_string(local_mem_ctx, dns[i]));
+		}
+		if (filter) {
+			filter = talloc_strdup_append_buffer(filter, ")");
+		}
+		OPENCHANGE_RETVAL_IF(!filter, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
 
-	/* Step 2. Retrieve property values and build aRow */
-	aRow->Reserved = 0x0;
-	aRow->cValues = pPropTags->cValues;
-	aRow->lpProps = talloc_array(mem_ctx, struct PropertyValue_r, aRow->cValues);
+		ret = ldb_search(emsabp_ctx->samdb_ctx, mem_ctx, &res,
+				 ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
+				 LDB_SCOPE_SUBTREE, attrs, "%s", filter);
+		for (j = 0; ret == LDB_SUCCESS && j < res->count; j++) {
+			dn = ldb_msg_find_attr_as_string(res->msgs[j], "distinguishedName", NULL);
+			if (!dn) continue;
+			for (i = 0; i < count; i++) {
+				if (dns[i] && !msgs[i] && !strcasecmp(dns[i], dn)) {
+					msgs[i] = res->msgs[j];
+				}
+			}
+		}
 
-	for (i = 0; i < aRow->cValues; i++) {
-		ulPropTag = pPropTags->aulPropTag[i];
-		data = emsabp_query(mem_ctx, emsabp_ctx, res->msgs[0], ulPropTag, MId, dwFlags);
-		if (!data) {
-			ulPropTag &= 0xFFFF0000;
-			ulPropTag += PT_ERROR;
+		/* Records outside the default naming context, such as
+		 * address book containers, are fetched one by one */
+		for (i = 0; i < count; i++) {
+			if (!dns[i] || msgs[i]) continue;
+
+			ldb_dn = ldb_dn_new(local_mem_ctx, emsabp_ctx->samdb_ctx, dns[i]);
+			if (!ldb_dn_validate(ldb_dn)) {
+				retvals[i] = MAPI_E_CORRUPT_STORE;
+				continue;
+			}
+			ret = ldb_search(emsabp_ctx->samdb_ctx, mem_ctx, &res, ldb_dn, LDB_SCOPE_BASE,
+					 attrs, NULL);
+			if (ret != LDB_SUCCESS || res->count != 1) {
+				retvals[i] = MAPI_E_CORRUPT_STORE;
+				continue;
+			}
+			msgs[i] = res->msgs[0];
 		}
+	}
 
-		aRow->lpProps[i].ulPropTag = (enum MAPITAGS) ulPropTag;
-		aRow->lpProps[i].dwAlignPad = 0x0;
-		set_PropertyValue(&(aRow->lpProps[i]), data);
+	/* Step 3. Retrieve property values and build the rows in MIds order */
+	for (i = 0; i < count; i++) {
+		if (retvals[i] != MAPI_E_SUCCESS) continue;
+		retvals[i] = emsabp_fetch_attrs_from_msg(mem_ctx, emsabp_ctx, &aRows[i], msgs[i],
+							 MIds[i], dwFlags, pPropTags);
 	}
 
+	talloc_free(local_mem_ctx);
 
 	return MAPI_E_SUCCESS;
 }
 
 
+/**
+   \details Builds the SRow array entry for the specified MId.
+
+   \param mem_ctx pointer to the memory context
+   \param emsabp_ctx pointer to the EMSABP context
+   \param aRow pointer to the SRow structure where results will be
+   stored
+   \param MId MId to fetch properties for
+   \param dwFlags bit flags specifying whether or not the server must
+   return the values of the property PidTagEntryId in the Ephemeral
+   or Permanent Entry ID format
+   \param pPropTags pointer to the property tags array
+
+   \sa emsabp_fetch_attrs_rows
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsabp_fetch_attrs(TALLOC_CTX *mem_ctx, struct emsabp_context *emsabp_ctx,
+					    struct PropertyRow_r *aRow, uint32_t MId, uint32_t dwFlags,
+					    struct SPropTagArray *pPropTags)
+{
+	enum MAPISTATUS		retval;
+	enum MAPISTATUS		row_retval;
+
+	retval = emsabp_fetch_attrs_rows(mem_ctx, emsabp_ctx, aRow, &MId, 1, dwFlags, pPropTags, &row_retval);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	return row_retval;
+}
+
+
 /**
    \details Builds the SRow array entry for the specified table
    record.
@@ -1079,6 +1171,15 @@ _PUBLIC_ enum MAPISTATUS emsabp_get_CreationTemplatesTable(TALLOC_CTX *mem_ctx,
 }
 
 
+static int emsabp_mid_row_cmp(const void *a, const void *b)
+{
+	uint32_t	MId_a = ((const struct emsabp_mid_row *)a)->MId;
+	uint32_t	MId_b = ((const struct emsabp_mid_row *)b)->MId;
+
+	return (MId_a > MId_b) - (MId_a < MId_b);
+}
+
+
 /**
     \details Include to some ldap filter the organizational restriction of the
     current user
@@ -1140,6 +1241,7 @@ _PUBLIC_ enum MAPISTATUS emsabp_search(TALLOC_CTX *mem_ctx, struct emsabp_contex
 	int				ldb_ret;
 	struct ldb_server_sort_control	**ldb_sort_controls = NULL;
 	struct ldb_request		*ldb_req;
+	struct emsabp_snapshot		*snapshot = NULL;
 
 	local_mem_ctx = talloc_new(NULL);
 	OPENCHANGE_RETVAL_IF(local_mem_ctx == NULL, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
@@ -1195,37 +1297,55 @@ _PUBLIC_ enum MAPISTATUS emsabp_search(TALLOC_CTX *mem_ctx, struct emsabp_contex
 	retval = emsabp_include_organization_restriction(emsabp_ctx, fmt_str, &search_filter);
 	OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, local_mem_ctx);
 
-	ldb_res = talloc_zero(local_mem_ctx, struct ldb_result);
-	OPENCHANGE_RETVAL_IF(ldb_res == NULL, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
-
-	ldb_req = NULL;
-	ldb_ret = ldb_build_search_req(&ldb_req, emsabp_ctx->samdb_ctx, local_mem_ctx,
-				       ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
-				       LDB_SCOPE_SUBTREE,
-				       search_filter,
-				       recipient_attrs,
-				       NULL,
-				       ldb_res,
-				       ldb_search_default_callback,
-				       NULL);
-	OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
-
-	if (ldb_sort_controls) {
-		ldb_request_add_control(ldb_req, LDB_CONTROL_SERVER_SORT_OID, false, ldb_sort_controls);
-	}
+	if (restriction == NULL) {
+		/* The whole address book is served from the shared snapshot */
+		retval = emsabp_snapshot_get(local_mem_ctx, emsabp_ctx, search_filter,
+					     (ldb_sort_controls != NULL), &snapshot);
+		OPENCHANGE_RETVAL_IF(retval != MAPI_E_SUCCESS, retval, local_mem_ctx);
+		ldb_res = snapshot->res;
+	} else {
+		ldb_res = talloc_zero(local_mem_ctx, struct ldb_result);
+		OPENCHANGE_RETVAL_IF(ldb_res == NULL, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+
+		ldb_req = NULL;
+		ldb_ret = ldb_build_search_req(&ldb_req, emsabp_ctx->samdb_ctx, local_mem_ctx,
+					       ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
+					       LDB_SCOPE_SUBTREE,
+					       search_filter,
+					       recipient_attrs,
+					       NULL,
+					       ldb_res,
+					       ldb_search_default_callback,
+					       NULL);
+		OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+
+		if (ldb_sort_controls) {
+			ldb_request_add_control(ldb_req, LDB_CONTROL_SERVER_SORT_OID, false, ldb_sort_controls);
+		}
 
-	ldb_ret = ldb_request(emsabp_ctx->samdb_ctx, ldb_req);
-	OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+		ldb_ret = ldb_request(emsabp_ctx->samdb_ctx, ldb_req);
+		OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
 
-	ldb_ret = ldb_wait(ldb_req->handle, LDB_WAIT_ALL);
-	OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+		ldb_ret = ldb_wait(ldb_req->handle, LDB_WAIT_ALL);
+		OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, local_mem_ctx);
+	}
 	OPENCHANGE_RETVAL_IF(ldb_res == NULL, MAPI_E_INVALID_OBJECT, local_mem_ctx);
 	OPENCHANGE_RETVAL_IF(ldb_res->count == 0, MAPI_E_NOT_FOUND, local_mem_ctx);
 	OPENCHANGE_RETVAL_IF(limit && ldb_res->count > limit, MAPI_E_TABLE_TOO_BIG, local_mem_ctx);
 
+	MIds->cValues = ldb_res->count;
+
+	/* The session already assigned MIds to this snapshot */
+	if (snapshot && snapshot == emsabp_ctx->mids_snapshot) {
+		MIds->aulPropTag = (uint32_t *) talloc_memdup(mem_ctx, emsabp_ctx->mids,
+							      ldb_res->count * sizeof (uint32_t));
+		OPENCHANGE_RETVAL_IF(MIds->aulPropTag == NULL, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+		talloc_free(local_mem_ctx);
+		return MAPI_E_SUCCESS;
+	}
+
 	MIds->aulPropTag = (uint32_t *) talloc_array(mem_ctx, uint32_t, ldb_res->count);
 	OPENCHANGE_RETVAL_IF(MIds->aulPropTag == NULL, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
-	MIds->cValues = ldb_res->count;
 
 	/* Step 2. Create session MId for all fetched records */
 
@@ -1240,11 +1360,141 @@ _PUBLIC_ enum MAPISTATUS emsabp_search(TALLOC_CTX *mem_ctx, struct emsabp_contex
 		}
 	}
 
+	/* Step 3. Keep the MIds of a shared snapshot for the next searches */
+	if (snapshot && snapshot->expires) {
+		if (emsabp_ctx->mids_snapshot) {
+			talloc_unlink(emsabp_ctx->mem_ctx, emsabp_ctx->mids_snapshot);
+			talloc_free(emsabp_ctx->mids);
+			emsabp_ctx->mids_snapshot = NULL;
+			emsabp_ctx->mids_index = NULL;
+			emsabp_ctx->mids_count = 0;
+		}
+		emsabp_ctx->mids = (uint32_t *) talloc_memdup(emsabp_ctx->mem_ctx, MIds->aulPropTag,
+							      ldb_res->count * sizeof (uint32_t));
+		if (emsabp_ctx->mids) {
+			emsabp_ctx->mids_snapshot = talloc_reference(emsabp_ctx->mem_ctx, snapshot);
+
+			/* Index the rows by MId, freed along with the MIds */
+			emsabp_ctx->mids_index = talloc_array(emsabp_ctx->mids, struct emsabp_mid_row, ldb_res->count);
+			if (emsabp_ctx->mids_index) {
+				for (i = 0; i < ldb_res->count; i++) {
+					emsabp_ctx->mids_index[i].MId = MIds->aulPropTag[i];
+					emsabp_ctx->mids_index[i].row = i;
+				}
+				qsort(emsabp_ctx->mids_index, ldb_res->count, sizeof (struct emsabp_mid_row),
+				      emsabp_mid_row_cmp);
+				emsabp_ctx->mids_count = ldb_res->count;
+			}
+		}
+	}
+
+	talloc_free(local_mem_ctx);
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Build the table of the members of a distribution list,
+   including the members of the groups nested in it
+
+   \param mem_ctx pointer to the memory context
+   \param emsabp_ctx pointer to the EMSABP context
+   \param MIds pointer to the returned table of MIds
+   \param MId the MId of the distribution list
+   \param limit the maximum number of members, 0 for no limit
+
+   \return MAPI_E_SUCCESS on success, MAPI_E_NOT_FOUND if the MId is
+   not a distribution list, MAPI_E_TABLE_TOO_BIG if the list has more
+   than limit members, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsabp_search_members(TALLOC_CTX *mem_ctx, struct emsabp_context *emsabp_ctx,
+					       struct PropertyTagArray_r *MIds, uint32_t MId, uint32_t limit)
+{
+	enum MAPISTATUS		retval;
+	TALLOC_CTX		*local_mem_ctx;
+	char			*dn;
+	char			**members;
+	uint32_t		count;
+	uint32_t		i;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsabp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!MIds, MAPI_E_INVALID_PARAMETER, NULL);
+
+	local_mem_ctx = talloc_new(NULL);
+	OPENCHANGE_RETVAL_IF(!local_mem_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	retval = emsabp_tdb_fetch_dn_from_MId(local_mem_ctx, emsabp_ctx->ttdb_ctx, MId, &dn);
+	OPENCHANGE_RETVAL_IF(retval, MAPI_E_NOT_FOUND, local_mem_ctx);
+
+	retval = mapiproxy_group_members(local_mem_ctx, emsabp_ctx->samdb_ctx, dn, &count, &members);
+	OPENCHANGE_RETVAL_IF(retval, retval, local_mem_ctx);
+	OPENCHANGE_RETVAL_IF(limit && count > limit, MAPI_E_TABLE_TOO_BIG, local_mem_ctx);
+
+	MIds->cValues = count;
+	MIds->aulPropTag = (uint32_t *) talloc_array(mem_ctx, uint32_t, count);
+	OPENCHANGE_RETVAL_IF(count && !MIds->aulPropTag, MAPI_E_NOT_ENOUGH_MEMORY, local_mem_ctx);
+
+	for (i = 0; i < count; i++) {
+		retval = emsabp_tdb_fetch_MId(emsabp_ctx->ttdb_ctx, members[i], (uint32_t *)&(MIds->aulPropTag[i]));
+		if (retval != MAPI_E_SUCCESS) {
+			retval = emsabp_tdb_insert(emsabp_ctx->ttdb_ctx, members[i]);
+			OPENCHANGE_RETVAL_IF(retval, MAPI_E_CORRUPT_STORE, local_mem_ctx);
+			retval = emsabp_tdb_fetch_MId(emsabp_ctx->ttdb_ctx, members[i], (uint32_t *)&(MIds->aulPropTag[i]));
+			OPENCHANGE_RETVAL_IF(retval, MAPI_E_CORRUPT_STORE, local_mem_ctx);
+		}
+	}
+
 	talloc_free(local_mem_ctx);
 	return MAPI_E_SUCCESS;
 }
 
 
+/**
+   \details Find the row of a MId in a table returned by emsabp_search
+
+   Tables served from the snapshot the session MIds are cached for are
+   looked up in the MId index, other tables are walked.
+
+   \param emsabp_ctx pointer to the EMSABP context
+   \param MIds pointer to the table MIds
+   \param MId the MId to look for
+   \param row pointer to the returned row
+
+   \return true if the MId is in the table, otherwise false
+ */
+_PUBLIC_ bool emsabp_mids_find_row(struct emsabp_context *emsabp_ctx, struct PropertyTagArray_r *MIds,
+				   uint32_t MId, uint32_t *row)
+{
+	struct emsabp_mid_row	key;
+	struct emsabp_mid_row	*entry;
+	uint32_t		i;
+
+	/* Sanity checks */
+	if (!MIds || !row) return false;
+
+	if (emsabp_ctx && emsabp_ctx->mids_index && MIds->cValues == emsabp_ctx->mids_count) {
+		key.MId = MId;
+		entry = (struct emsabp_mid_row *) bsearch(&key, emsabp_ctx->mids_index, emsabp_ctx->mids_count,
+							   sizeof (struct emsabp_mid_row), emsabp_mid_row_cmp);
+		/* The table may have the same size without coming from the snapshot */
+		if (entry && MIds->aulPropTag[entry->row] == MId) {
+			*row = entry->row;
+			return true;
+		}
+	}
+
+	for (i = 0; i < MIds->cValues; i++) {
+		if (MIds->aulPropTag[i] == MId) {
+			*row = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
 /**
    \details Search for a given DN within AD and return the associated
    LDB message.
@@ -1393,6 +1643,9 @@ _PUBLIC_ enum MAPISTATUS emsabp_ab_fetch_filter(TALLOC_CTX *mem_ctx,
    \param ldb_resp pointer on pointer to the LDB result returned by the
    function
 
+   \note The LDB result belongs to an address book snapshot referenced
+   by mem_ctx and must not be modified.
+
    \return MAPI_E_SUCCESS on success, otherwise MAPI error
  */
 _PUBLIC_ enum MAPISTATUS emsabp_ab_container_enum(TALLOC_CTX *mem_ctx,
@@ -1401,12 +1654,8 @@ _PUBLIC_ enum MAPISTATUS emsabp_ab_container_enum(TALLOC_CTX *mem_ctx,
 						  struct ldb_result **ldb_resp)
 {
 	enum MAPISTATUS			retval;
-	int				ldb_ret;
-	struct ldb_request		*ldb_req;
-	struct ldb_result		*ldb_res;
 	char				*filter_search;
-	const char * const		recipient_attrs[] = { "*", NULL };
-	struct ldb_server_sort_control	**ldb_sort_controls;
+	struct emsabp_snapshot		*snapshot;
 
 	/* Fetch AB container record */
 	retval = emsabp_ab_fetch_filter(mem_ctx, emsabp_ctx, ContainerID, &filter_search);
@@ -1417,45 +1666,15 @@ _PUBLIC_ enum MAPISTATUS emsabp_ab_container_enum(TALLOC_CTX *mem_ctx,
 		return MAPI_E_SUCCESS;
 	}
 
-	/* Search AD with filter_search */
-	ldb_res = talloc_zero(mem_ctx, struct ldb_result);
-	OPENCHANGE_RETVAL_IF(!ldb_res, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
-
-	ldb_req = NULL;
-	ldb_ret = ldb_build_search_req(&ldb_req, emsabp_ctx->samdb_ctx, mem_ctx,
-				       ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
-				       LDB_SCOPE_SUBTREE,
-				       filter_search,
-				       recipient_attrs,
-				       NULL,
-				       ldb_res,
-				       ldb_search_default_callback,
-				       NULL);
-	if (ldb_ret != LDB_SUCCESS) goto done;
-
-	ldb_sort_controls = talloc_zero_array(filter_search, struct ldb_server_sort_control *, 2);
-	ldb_sort_controls[0] = talloc_zero(ldb_sort_controls, struct ldb_server_sort_control);
-	ldb_sort_controls[0]->attributeName = talloc_strdup(ldb_sort_controls, "displayName");
-	ldb_request_add_control(ldb_req, LDB_CONTROL_SERVER_SORT_OID, false, ldb_sort_controls);
-
-	ldb_ret = ldb_request(emsabp_ctx->samdb_ctx, ldb_req);
-
-	if (ldb_ret == LDB_SUCCESS) {
-		ldb_ret = ldb_wait(ldb_req->handle, LDB_WAIT_ALL);
-	}
-
-done:
+	/* Entries sorted by displayName, from the container snapshot */
+	retval = emsabp_snapshot_get(mem_ctx, emsabp_ctx, filter_search, true, &snapshot);
 	talloc_free(filter_search);
-	if (ldb_req) {
-		talloc_free(ldb_req);
-	}
-
-	if (ldb_ret != LDB_SUCCESS) {
-		talloc_free(ldb_res);
-		ldb_res = NULL;
+	if (retval != MAPI_E_SUCCESS) {
+		*ldb_resp = NULL;
+		return MAPI_E_NOT_FOUND;
 	}
 
-	*ldb_resp = ldb_res;
+	*ldb_resp = snapshot->res;
 
-	return (ldb_ret != LDB_SUCCESS) ? MAPI_E_NOT_FOUND : MAPI_E_SUCCESS;
+	return MAPI_E_SUCCESS;
 }
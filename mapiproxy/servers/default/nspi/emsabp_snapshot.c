@@ -0,0 +1,475 @@
+/*
+   OpenChange Server implementation.
+
+   EMSABP: Address Book Provider implementation
+
+   Copyright (C) OpenChange Project 2015.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file emsabp_snapshot.c
+
+   \brief Address Book snapshots
+
+   A snapshot holds the result of an address book search, with every
+   attribute of the entries. Snapshots are shared by all the sessions
+   of the process and are replaced as soon as the sequence number of
+   the directory changes, or once they are older than
+   exchange_nsp:snapshot_ttl seconds. The entries of a snapshot are
+   never modified after it is built, only indexes are added on first
+   use: sessions keep a reference on the snapshot they are using, so a
+   refresh does not free it under their feet.
+ */
+
+#include "mapiproxy/dcesrv_mapiproxy.h"
+#include "dcesrv_exchange_nsp.h"
+
+/* Attributes matched by ambiguous name resolution. We do not use
+   proxyAddresses because we do not expect the user to type in the
+   protocol, nor the RDN which is the same than name for users */
+const char * const emsabp_anr_attrs[] = { "mailNickName", "mail", "name",
+					  "displayName", "givenName", "sn",
+					  "sAMAccountName",
+					  "legacyExchangeDN",
+					  "physicalDeliveryOfficeName",
+					  NULL };
+
+/* Snapshots shared by all the sessions of the process */
+static struct emsabp_snapshot	*snapshots = NULL;
+static TALLOC_CTX		*snapshots_ctx = NULL;
+static uint64_t			snapshots_seq_num = 0;
+
+
+/**
+   \details Return the DN of a snapshot entry as stored in the TDB
+   databases
+ */
+static const char *emsabp_snapshot_msg_dn(struct ldb_message *msg)
+{
+	const char	*dn;
+
+	dn = ldb_msg_find_attr_as_string(msg, "distinguishedName", NULL);
+	if (!dn) {
+		dn = ldb_dn_get_linearized(msg->dn);
+	}
+
+	return dn;
+}
+
+
+static int emsabp_snapshot_entry_cmp(const void *a, const void *b)
+{
+	const struct emsabp_snapshot_entry	*ea = (const struct emsabp_snapshot_entry *)a;
+	const struct emsabp_snapshot_entry	*eb = (const struct emsabp_snapshot_entry *)b;
+
+	return strcasecmp(ea->key, eb->key);
+}
+
+
+static int emsabp_snapshot_anr_cmp(const void *a, const void *b)
+{
+	const struct emsabp_snapshot_entry	*ea = (const struct emsabp_snapshot_entry *)a;
+	const struct emsabp_snapshot_entry	*eb = (const struct emsabp_snapshot_entry *)b;
+
+	return strcmp(ea->key, eb->key);
+}
+
+
+/**
+   \details Build the ambiguous name resolution index of a snapshot:
+   the lower case values of the ANR attributes of every entry, sorted
+   so prefixes can be looked up with a binary search
+
+   \param snapshot pointer to the snapshot to index
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsabp_snapshot_anr_build(struct emsabp_snapshot *snapshot)
+{
+	struct ldb_message_element	*el;
+	uint32_t			count = 0;
+	uint32_t			i, j, k;
+
+	for (i = 0; i < snapshot->res->count; i++) {
+		for (j = 0; emsabp_anr_attrs[j]; j++) {
+			el = ldb_msg_find_element(snapshot->res->msgs[i], emsabp_anr_attrs[j]);
+			if (el) count += el->num_values;
+		}
+	}
+
+	snapshot->anr = talloc_array(snapshot, struct emsabp_snapshot_entry, count ? count : 1);
+	OPENCHANGE_RETVAL_IF(!snapshot->anr, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	snapshot->anr_count = 0;
+	for (i = 0; i < snapshot->res->count; i++) {
+		for (j = 0; emsabp_anr_attrs[j]; j++) {
+			el = ldb_msg_find_element(snapshot->res->msgs[i], emsabp_anr_attrs[j]);
+			if (!el) continue;
+			for (k = 0; k < el->num_values; k++) {
+				snapshot->anr[snapshot->anr_count].key = strlower_talloc(snapshot->anr,
+											(const char *)el->values[k].data);
+				if (!snapshot->anr[snapshot->anr_count].key) continue;
+				snapshot->anr[snapshot->anr_count].msg = snapshot->res->msgs[i];
+				snapshot->anr_count++;
+			}
+		}
+	}
+
+	if (snapshot->anr_count > 1) {
+		qsort(snapshot->anr, snapshot->anr_count, sizeof (struct emsabp_snapshot_entry),
+		      emsabp_snapshot_anr_cmp);
+	}
+	snapshot->anr_indexed = true;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Search the directory and build a new snapshot
+
+   \param mem_ctx pointer to the memory context
+   \param emsabp_ctx pointer to the EMSABP context
+   \param filter the LDAP filter of the search
+   \param sorted whether entries are sorted by displayName
+   \param snapshotp pointer on pointer to the snapshot to return
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsabp_snapshot_build(TALLOC_CTX *mem_ctx,
+					     struct emsabp_context *emsabp_ctx,
+					     const char *filter,
+					     bool sorted,
+					     struct emsabp_snapshot **snapshotp)
+{
+	struct emsabp_snapshot		*snapshot;
+	struct ldb_request		*ldb_req = NULL;
+	struct ldb_server_sort_control	**ldb_sort_controls;
+	const char * const		recipient_attrs[] = { "*", NULL };
+	int				ldb_ret;
+	uint32_t			i, j;
+
+	snapshot = talloc_zero(mem_ctx, struct emsabp_snapshot);
+	OPENCHANGE_RETVAL_IF(!snapshot, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	snapshot->filter = talloc_strdup(snapshot, filter);
+	OPENCHANGE_RETVAL_IF(!snapshot->filter, MAPI_E_NOT_ENOUGH_MEMORY, snapshot);
+	snapshot->sorted = sorted;
+
+	snapshot->res = talloc_zero(snapshot, struct ldb_result);
+	OPENCHANGE_RETVAL_IF(!snapshot->res, MAPI_E_NOT_ENOUGH_MEMORY, snapshot);
+
+	ldb_ret = ldb_build_search_req(&ldb_req, emsabp_ctx->samdb_ctx, snapshot,
+				       ldb_get_default_basedn(emsabp_ctx->samdb_ctx),
+				       LDB_SCOPE_SUBTREE,
+				       snapshot->filter,
+				       recipient_attrs,
+				       NULL,
+				       snapshot->res,
+				       ldb_search_default_callback,
+				       NULL);
+	OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, snapshot);
+
+	if (sorted) {
+		ldb_sort_controls = talloc_zero_array(ldb_req, struct ldb_server_sort_control *, 2);
+		OPENCHANGE_RETVAL_IF(!ldb_sort_controls, MAPI_E_NOT_ENOUGH_MEMORY, snapshot);
+		ldb_sort_controls[0] = talloc_zero(ldb_sort_controls, struct ldb_server_sort_control);
+		OPENCHANGE_RETVAL_IF(!ldb_sort_controls[0], MAPI_E_NOT_ENOUGH_MEMORY, snapshot);
+		ldb_sort_controls[0]->attributeName = talloc_strdup(ldb_sort_controls, "displayName");
+		OPENCHANGE_RETVAL_IF(!ldb_sort_controls[0]->attributeName, MAPI_E_NOT_ENOUGH_MEMORY, snapshot);
+		ldb_request_add_control(ldb_req, LDB_CONTROL_SERVER_SORT_OID, false, ldb_sort_controls);
+	}
+
+	ldb_ret = ldb_request(emsabp_ctx->samdb_ctx, ldb_req);
+	if (ldb_ret == LDB_SUCCESS) {
+		ldb_ret = ldb_wait(ldb_req->handle, LDB_WAIT_ALL);
+	}
+	talloc_free(ldb_req);
+	OPENCHANGE_RETVAL_IF(ldb_ret != LDB_SUCCESS, MAPI_E_NOT_FOUND, snapshot);
+
+	/* Index the entries by DN */
+	if (snapshot->res->count) {
+		snapshot->by_dn = talloc_array(snapshot, struct emsabp_snapshot_entry, snapshot->res->count);
+		OPENCHANGE_RETVAL_IF(!snapshot->by_dn, MAPI_E_NOT_ENOUGH_MEMORY, snapshot);
+	}
+	for (i = 0, j = 0; i < snapshot->res->count; i++) {
+		snapshot->by_dn[j].key = emsabp_snapshot_msg_dn(snapshot->res->msgs[i]);
+		if (!snapshot->by_dn[j].key) continue;
+		snapshot->by_dn[j].msg = snapshot->res->msgs[i];
+		j++;
+	}
+	snapshot->by_dn_count = j;
+	if (snapshot->by_dn_count > 1) {
+		qsort(snapshot->by_dn, snapshot->by_dn_count, sizeof (struct emsabp_snapshot_entry),
+		      emsabp_snapshot_entry_cmp);
+	}
+
+	*snapshotp = snapshot;
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Retrieve the highest sequence number of the directory, it
+   changes with every modification of the entries
+
+   \param emsabp_ctx pointer to the EMSABP context
+   \param seq_num pointer to the sequence number to return
+
+   \return true on success, false if the directory does not provide
+   sequence numbers
+ */
+static bool emsabp_snapshot_seq_num(struct emsabp_context *emsabp_ctx, uint64_t *seq_num)
+{
+	int	ldb_ret;
+
+	ldb_ret = ldb_sequence_number(emsabp_ctx->samdb_ctx, LDB_SEQ_HIGHEST_SEQ, seq_num);
+	if (ldb_ret != LDB_SUCCESS) {
+		OC_DEBUG(5, "[nspi] No directory sequence number: %s",
+			 ldb_errstring(emsabp_ctx->samdb_ctx));
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+   \details Return whether address book searches are kept in shared
+   snapshots
+
+   \param emsabp_ctx pointer to the EMSABP context
+
+   \return true if snapshots are enabled, otherwise false
+ */
+_PUBLIC_ bool emsabp_snapshot_enabled(struct emsabp_context *emsabp_ctx)
+{
+	if (!emsabp_ctx) return false;
+
+	return (lpcfg_parm_int(emsabp_ctx->lp_ctx, NULL, "exchange_nsp", "snapshot_ttl",
+			       EMSABP_SNAPSHOT_TTL) > 0);
+}
+
+
+/**
+   \details Retrieve the snapshot of an address book search, searching
+   the directory if no valid snapshot exists yet
+
+   \param mem_ctx pointer to the memory context the snapshot is
+   referenced by
+   \param emsabp_ctx pointer to the EMSABP context
+   \param filter the LDAP filter of the search
+   \param sorted whether entries must be sorted by displayName
+   \param snapshotp pointer on pointer to the snapshot to return
+
+   \note The snapshot must not be modified. It remains valid until
+   mem_ctx is released.
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsabp_snapshot_get(TALLOC_CTX *mem_ctx,
+					     struct emsabp_context *emsabp_ctx,
+					     const char *filter,
+					     bool sorted,
+					     struct emsabp_snapshot **snapshotp)
+{
+	enum MAPISTATUS		retval;
+	struct emsabp_snapshot	*snapshot;
+	struct emsabp_snapshot	*next;
+	time_t			now;
+	uint64_t		seq_num;
+	int			ttl;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!emsabp_ctx, MAPI_E_NOT_INITIALIZED, NULL);
+	OPENCHANGE_RETVAL_IF(!filter || !snapshotp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	ttl = lpcfg_parm_int(emsabp_ctx->lp_ctx, NULL, "exchange_nsp", "snapshot_ttl", EMSABP_SNAPSHOT_TTL);
+	if (ttl <= 0) {
+		/* Snapshots are disabled: search the directory each time */
+		return emsabp_snapshot_build(mem_ctx, emsabp_ctx, filter, sorted, snapshotp);
+	}
+
+	if (!snapshots_ctx) {
+		snapshots_ctx = talloc_named(talloc_autofree_context(), 0, "emsabp_snapshots");
+		OPENCHANGE_RETVAL_IF(!snapshots_ctx, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	}
+
+	/* Snapshots built before a change of the directory are stale,
+	 * whatever their age. Directories without sequence numbers only
+	 * rely on the TTL. */
+	if (emsabp_snapshot_seq_num(emsabp_ctx, &seq_num)) {
+		snapshots_seq_num = seq_num;
+	}
+
+	/* Drop the expired snapshots, sessions still using them keep
+	 * their reference */
+	now = time(NULL);
+	for (snapshot = snapshots; snapshot; snapshot = next) {
+		next = snapshot->next;
+		if (snapshot->expires <= now || snapshot->seq_num != snapshots_seq_num) {
+			DLIST_REMOVE(snapshots, snapshot);
+			talloc_unlink(snapshots_ctx, snapshot);
+		}
+	}
+
+	for (snapshot = snapshots; snapshot; snapshot = snapshot->next) {
+		if (snapshot->sorted == sorted && !strcmp(snapshot->filter, filter)) {
+			break;
+		}
+	}
+
+	if (!snapshot) {
+		retval = emsabp_snapshot_build(snapshots_ctx, emsabp_ctx, filter, sorted, &snapshot);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		snapshot->expires = now + ttl;
+		snapshot->seq_num = snapshots_seq_num;
+		DLIST_ADD(snapshots, snapshot);
+		OC_DEBUG(5, "[nspi] New address book snapshot with %u entries for %s at sequence number %"PRIu64,
+			 snapshot->res->count, filter, snapshot->seq_num);
+	}
+
+	*snapshotp = talloc_reference(mem_ctx, snapshot);
+	OPENCHANGE_RETVAL_IF(!*snapshotp, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Find the entry of a snapshot from its DN
+
+   \param snapshot pointer to the snapshot to search
+   \param dn the DN of the entry
+
+   \return pointer to the LDB message of the entry on success,
+   otherwise NULL
+ */
+_PUBLIC_ struct ldb_message *emsabp_snapshot_find_dn(struct emsabp_snapshot *snapshot,
+						     const char *dn)
+{
+	struct emsabp_snapshot_entry	needle;
+	struct emsabp_snapshot_entry	*entry;
+
+	if (!snapshot || !dn || !snapshot->by_dn_count) return NULL;
+
+	needle.key = dn;
+	needle.msg = NULL;
+	entry = (struct emsabp_snapshot_entry *) bsearch(&needle, snapshot->by_dn, snapshot->by_dn_count,
+							 sizeof (struct emsabp_snapshot_entry),
+							 emsabp_snapshot_entry_cmp);
+
+	return entry ? entry->msg : NULL;
+}
+
+
+/**
+   \details Find the entry of a DN within the valid snapshots of the
+   process
+
+   \param mem_ctx pointer to the memory context the snapshot of the
+   entry is referenced by
+   \param dn the DN of the entry
+
+   \return pointer to the LDB message of the entry on success,
+   otherwise NULL
+ */
+_PUBLIC_ struct ldb_message *emsabp_snapshot_lookup_dn(TALLOC_CTX *mem_ctx, const char *dn)
+{
+	struct emsabp_snapshot	*snapshot;
+	struct ldb_message	*msg;
+	time_t			now;
+
+	now = time(NULL);
+	for (snapshot = snapshots; snapshot; snapshot = snapshot->next) {
+		if (snapshot->expires <= now || snapshot->seq_num != snapshots_seq_num) continue;
+		msg = emsabp_snapshot_find_dn(snapshot, dn);
+		if (msg && talloc_reference(mem_ctx, snapshot)) return msg;
+	}
+
+	return NULL;
+}
+
+
+/**
+   \details Look for the entries of a snapshot having one of their ANR
+   attributes starting with the given name
+
+   \param snapshot pointer to the snapshot to search
+   \param name the name to resolve
+   \param MIdStatus pointer to the resolution status to return:
+   MAPI_UNRESOLVED, MAPI_AMBIGUOUS or MAPI_RESOLVED
+   \param msgp pointer on pointer to the resolved entry, only set when
+   the name is resolved
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+_PUBLIC_ enum MAPISTATUS emsabp_snapshot_anr(struct emsabp_snapshot *snapshot,
+					     const char *name,
+					     uint32_t *MIdStatus,
+					     struct ldb_message **msgp)
+{
+	enum MAPISTATUS		retval;
+	struct ldb_message	*msg = NULL;
+	char			*prefix;
+	size_t			len;
+	uint32_t		low, high, mid;
+
+	/* Sanity checks */
+	OPENCHANGE_RETVAL_IF(!snapshot || !name, MAPI_E_INVALID_PARAMETER, NULL);
+	OPENCHANGE_RETVAL_IF(!MIdStatus || !msgp, MAPI_E_INVALID_PARAMETER, NULL);
+
+	if (!snapshot->anr_indexed) {
+		retval = emsabp_snapshot_anr_build(snapshot);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	prefix = strlower_talloc(snapshot, name);
+	OPENCHANGE_RETVAL_IF(!prefix, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+	len = strlen(prefix);
+
+	/* Find the first value not lower than the prefix */
+	low = 0;
+	high = snapshot->anr_count;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (strcmp(snapshot->anr[mid].key, prefix) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	/* Values sharing the prefix follow each other */
+	*MIdStatus = MAPI_UNRESOLVED;
+	for (; low < snapshot->anr_count && !strncmp(snapshot->anr[low].key, prefix, len); low++) {
+		if (!msg) {
+			msg = snapshot->anr[low].msg;
+			*MIdStatus = MAPI_RESOLVED;
+		} else if (msg != snapshot->anr[low].msg) {
+			*MIdStatus = MAPI_AMBIGUOUS;
+			break;
+		}
+	}
+	talloc_free(prefix);
+
+	if (*MIdStatus == MAPI_RESOLVED) {
+		*msgp = msg;
+	}
+
+	return MAPI_E_SUCCESS;
+}
@@ -36,6 +36,75 @@ struct traverse_MId {
 	bool		found;
 };
 
+/**
+   \details Store the reverse MId to DN record of a TDB entry, so the
+   DN of a MId can be fetched without traversing the database
+
+   \param tdb_ctx pointer to the EMSABP TDB context
+   \param MId the MId of the entry
+   \param dn the DN of the entry
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI error
+ */
+static enum MAPISTATUS emsabp_tdb_store_MId_DN(TDB_CONTEXT *tdb_ctx,
+					       uint32_t MId,
+					       const char *dn)
+{
+	char		keyname[sizeof (EMSABP_TDB_MID_DN_REC) + 8];
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+	int		ret;
+
+	snprintf(keyname, sizeof (keyname), EMSABP_TDB_MID_DN_REC, MId);
+	key.dptr = (unsigned char *) keyname;
+	key.dsize = strlen(keyname);
+
+	dbuf.dptr = (unsigned char *) dn;
+	dbuf.dsize = strlen(dn);
+
+	ret = tdb_store(tdb_ctx, key, dbuf, TDB_REPLACE);
+	OPENCHANGE_RETVAL_IF(ret == -1, MAPI_E_CORRUPT_STORE, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/**
+   \details Fetch the DN of a MId from its reverse record
+
+   \param mem_ctx pointer to the memory context
+   \param tdb_ctx pointer to the EMSABP TDB context
+   \param MId the MId to lookup
+   \param dn pointer on pointer to the dn to return, may be NULL
+
+   \return MAPI_E_SUCCESS on success, otherwise MAPI_E_NOT_FOUND
+ */
+static enum MAPISTATUS emsabp_tdb_fetch_MId_DN(TALLOC_CTX *mem_ctx,
+					       TDB_CONTEXT *tdb_ctx,
+					       uint32_t MId,
+					       char **dn)
+{
+	char		keyname[sizeof (EMSABP_TDB_MID_DN_REC) + 8];
+	TDB_DATA	key;
+	TDB_DATA	dbuf;
+
+	snprintf(keyname, sizeof (keyname), EMSABP_TDB_MID_DN_REC, MId);
+	key.dptr = (unsigned char *) keyname;
+	key.dsize = strlen(keyname);
+
+	dbuf = tdb_fetch(tdb_ctx, key);
+	OPENCHANGE_RETVAL_IF(!dbuf.dptr, MAPI_E_NOT_FOUND, NULL);
+
+	if (dn) {
+		*dn = talloc_strndup(mem_ctx, (char *)dbuf.dptr, dbuf.dsize);
+	}
+	free(dbuf.dptr);
+	OPENCHANGE_RETVAL_IF(dn && !*dn, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+
 /**
    \details Open EMSABP TDB database
 
@@ -230,6 +299,11 @@ static int emsabp_tdb_traverse_MId(TDB_CONTEXT *tdb_ctx,
 	char			*value_str = NULL;
 	struct traverse_MId	*mid_trav = (struct traverse_MId *) state;
 
+	/* Reverse records hold a DN, not a MId */
+	if (key.dptr && !strncmp((const char *)key.dptr, EMSABP_TDB_MID_DN_PREFIX, strlen(EMSABP_TDB_MID_DN_PREFIX))) {
+		return 0;
+	}
+
 	mem_ctx = talloc_named(NULL, 0, "emsabp_tdb_traverse_MId");
 	value_str = talloc_strndup(mem_ctx, (char *)dbuf.dptr, dbuf.dsize);
 	value = strtol((const char *)value_str, NULL, 16);
@@ -245,8 +319,9 @@ static int emsabp_tdb_traverse_MId(TDB_CONTEXT *tdb_ctx,
 
 
 /**
-   \details Traverse the EMSABP TDB database and look for the input
-   MId
+   \details Look for the input MId in the EMSABP TDB database. The
+   reverse record is checked first, and the database is only traversed
+   for entries stored without one.
 
    \param tdb_ctx pointer to the EMSABP TDB context
    \param MId MID to lookup
@@ -259,6 +334,10 @@ _PUBLIC_ bool emsabp_tdb_lookup_MId(TDB_CONTEXT *tdb_ctx,
 	int			ret;
 	struct traverse_MId	mid_trav = { MId, false };
 
+	if (emsabp_tdb_fetch_MId_DN(NULL, tdb_ctx, MId, NULL) == MAPI_E_SUCCESS) {
+		return true;
+	}
+
 	ret = tdb_traverse(tdb_ctx, emsabp_tdb_traverse_MId, (void *)&mid_trav);
 
 	return (ret > 0) && mid_trav.found;
@@ -290,8 +369,9 @@ static int emsabp_tdb_traverse_MId_DN(TDB_CONTEXT *tdb_ctx,
 
 
 /**
-   \details Traverse the EMSABP TDB and fetch the DN associated with
-   the MId
+   \details Fetch the DN associated with the MId. Entries stored
+   without a reverse record are found by traversing the EMSABP TDB,
+   and get their reverse record added on the way.
 
    \param mem_ctx pointer to the memory context
    \param tdb_ctx pointer to the EMSABP TDB context
@@ -307,7 +387,11 @@ _PUBLIC_ enum MAPISTATUS emsabp_tdb_fetch_dn_from_MId(TALLOC_CTX *mem_ctx,
 {
 	int			ret;
 	struct emsabp_MId	*emsabp_MId;
-	
+
+	if (emsabp_tdb_fetch_MId_DN(mem_ctx, tdb_ctx, MId, dn) == MAPI_E_SUCCESS) {
+		return MAPI_E_SUCCESS;
+	}
+
 	emsabp_MId = talloc_zero(mem_ctx, struct emsabp_MId);
 	emsabp_MId->dn = NULL;
 	emsabp_MId->MId = MId;
@@ -315,6 +399,7 @@ _PUBLIC_ enum MAPISTATUS emsabp_tdb_fetch_dn_from_MId(TALLOC_CTX *mem_ctx,
 	ret = tdb_traverse(tdb_ctx, emsabp_tdb_traverse_MId_DN, (void *)emsabp_MId);
 	if (ret > -1 && emsabp_MId->dn) {
 		*dn = talloc_strdup(mem_ctx, emsabp_MId->dn);
+		emsabp_tdb_store_MId_DN(tdb_ctx, MId, emsabp_MId->dn);
 		talloc_free(emsabp_MId);
 		return MAPI_E_SUCCESS;
 	}
@@ -383,6 +468,10 @@ _PUBLIC_ enum MAPISTATUS emsabp_tdb_insert(TDB_CONTEXT *tdb_ctx,
 	ret = tdb_store(tdb_ctx, key, dbuf, TDB_MODIFY);
 	OPENCHANGE_RETVAL_IF(ret == -1, MAPI_E_CORRUPT_STORE, mem_ctx);
 
+	/* Step 5. Add the reverse record */
+	retval = emsabp_tdb_store_MId_DN(tdb_ctx, index, keyname);
+	OPENCHANGE_RETVAL_IF(retval, retval, mem_ctx);
+
 	talloc_free(mem_ctx);
 
 	return MAPI_E_SUCCESS;
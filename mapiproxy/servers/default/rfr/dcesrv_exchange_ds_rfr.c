@@ -29,6 +29,36 @@
 #include "libmapi/oc_log.h"
 #include "dcesrv_exchange_ds_rfr.h"
 
+/* Every client asks for the referral when it starts: it only depends on
+   the configuration and is computed once per process */
+static char	*rfr_server_fqdn = NULL;
+
+/**
+   \details Return the lowercase FQDN of this server, NULL if the
+   netbios name or realm is not configured
+
+   \param lp_ctx pointer to the loadparm context
+ */
+static const char *dcesrv_exchange_ds_rfr_fqdn(struct loadparm_context *lp_ctx)
+{
+	const char	*netbiosname = NULL;
+	const char	*realm = NULL;
+	char		*fqdn;
+
+	if (rfr_server_fqdn) return rfr_server_fqdn;
+
+	netbiosname = lpcfg_netbios_name(lp_ctx);
+	realm = lpcfg_realm(lp_ctx);
+	if (!netbiosname || !realm) return NULL;
+
+	fqdn = talloc_asprintf(NULL, "%s.%s", netbiosname, realm);
+	if (!fqdn) return NULL;
+	rfr_server_fqdn = strlower_talloc(NULL, fqdn);
+	talloc_free(fqdn);
+
+	return rfr_server_fqdn;
+}
+
 /**
    \details exchange_ds_rfr RfrGetNewDSA (0x0) function
 
@@ -45,9 +75,7 @@ static enum MAPISTATUS dcesrv_RfrGetNewDSA(struct dcesrv_call_state *dce_call,
 					   TALLOC_CTX *mem_ctx,
 					   struct RfrGetNewDSA *r)
 {
-	const char		*netbiosname = NULL;
-	const char		*realm = NULL;
-	char			*fqdn = NULL;
+	const char		*fqdn = NULL;
 
 	OC_DEBUG(5, "exchange_ds_rfr: RfrGetNewDSA (0x0)");
 
@@ -62,19 +90,17 @@ static enum MAPISTATUS dcesrv_RfrGetNewDSA(struct dcesrv_call_state *dce_call,
 	}
 
 	/* Step 1. We don't have load-balancing support yet, just return Samba FQDN name */
-	netbiosname = lpcfg_netbios_name(dce_call->conn->dce_ctx->lp_ctx);
-	realm = lpcfg_realm(dce_call->conn->dce_ctx->lp_ctx);
-	if (!netbiosname || !realm) {
+	fqdn = dcesrv_exchange_ds_rfr_fqdn(dce_call->conn->dce_ctx->lp_ctx);
+	if (!fqdn) {
 		r->out.ppszUnused = NULL;
 		r->out.ppszServer = NULL;
 		r->out.result = MAPI_E_NO_SUPPORT;
 		return MAPI_E_NO_SUPPORT;			
 	}
 
-	fqdn = talloc_asprintf(mem_ctx, "%s.%s", netbiosname, realm);
 	r->out.ppszUnused = NULL;
 	r->out.ppszServer = talloc_array(mem_ctx, const char *, 2);
-	r->out.ppszServer[0] = strlower_talloc(mem_ctx, fqdn);
+	r->out.ppszServer[0] = talloc_strdup(mem_ctx, fqdn);
 	r->out.ppszServer[1] = NULL;
 	r->out.result = MAPI_E_SUCCESS;
 
@@ -95,9 +121,7 @@ static enum MAPISTATUS dcesrv_RfrGetFQDNFromLegacyDN(struct dcesrv_call_state *d
 						     TALLOC_CTX *mem_ctx,
 						     struct RfrGetFQDNFromLegacyDN *r)
 {
-	char		*fqdn;
-	const char	*netbiosname = NULL;
-	const char	*realm = NULL;
+	const char	*fqdn;
 
 	OC_DEBUG(3, "exchange_ds_rfr: RfrGetFQDNFromLegacyDN (0x1)");
 
@@ -111,16 +135,13 @@ static enum MAPISTATUS dcesrv_RfrGetFQDNFromLegacyDN(struct dcesrv_call_state *d
 		return MAPI_E_LOGON_FAILED;
 	}
 
-	netbiosname = lpcfg_netbios_name(dce_call->conn->dce_ctx->lp_ctx);
-	realm = lpcfg_realm(dce_call->conn->dce_ctx->lp_ctx);
-	if (!netbiosname || !realm) {
+	fqdn = dcesrv_exchange_ds_rfr_fqdn(dce_call->conn->dce_ctx->lp_ctx);
+	if (!fqdn) {
 		goto failure;
 	}
 
-	fqdn = talloc_asprintf(mem_ctx, "%s.%s", netbiosname, realm);
 	r->out.ppszServerFQDN = talloc_array(mem_ctx, const char *, 2);
-	r->out.ppszServerFQDN[0] = strlower_talloc(mem_ctx, fqdn);
-	talloc_free(fqdn);
+	r->out.ppszServerFQDN[0] = talloc_strdup(mem_ctx, fqdn);
 	r->out.result = MAPI_E_SUCCESS;
 
 	return MAPI_E_SUCCESS;
@@ -175,6 +196,8 @@ static NTSTATUS dcesrv_exchange_ds_rfr_dispatch(struct dcesrv_call_state *dce_ca
  */
 static NTSTATUS dcesrv_exchange_ds_rfr_init(struct dcesrv_context *dce_ctx)
 {
+	dcesrv_exchange_ds_rfr_fqdn(dce_ctx->lp_ctx);
+
 	return NT_STATUS_OK;
 }
 
@@ -30,6 +30,7 @@ import ocsmanager.lib.app_globals as app_globals
 import ocsmanager.lib.helpers
 import ocsmanager.lib.config as OCSConfig
 import openchange.mapistore as mapistore
+from openchange.shard import load_ring
 from ocsmanager.config.routing import make_map
 from ocsmanager.lib.openchangedb import get_openchangedb
 from ocsmanager.lib.samdb import SamDBWrapper
@@ -91,6 +92,12 @@ def _load_samba_environment():
     if not firstou:
         raise Exception("Cannot find exchange first organization unit in samba database")    
 
+    # Where the server processes write their statistics, see
+    # mapiproxy:runtime_stats and emsmdb:rop_stats
+    lock_dir = params.get("lock dir")
+    runtime_stats_dir = params.get("mapiproxy:runtime_stats_dir") or lock_dir
+    rop_stats_dir = params.get("emsmdb:rop_stats_dir") or lock_dir
+
     username_mail = False
     if params.get("auth:usernames are emails") == 'yes':
         username_mail = True
@@ -100,6 +107,7 @@ def _load_samba_environment():
                    "domaindn": domaindn,
                    "oc_user_basedn": "CN=%s,CN=%s,CN=%s,%s" \
                        % (firstou, firstorg, netbiosname, domaindn),
+                   "firstorg": firstorg,
                    "firstorgdn": ("CN=%s,CN=Microsoft Exchange,CN=Services,%s"
                                   % (firstorg, configdn)),
                    "legacyserverdn": ("/o=%s/ou=%s/cn=Configuration/cn=Servers"
@@ -108,6 +116,10 @@ def _load_samba_environment():
                    "hostname": hostname,
                    "dnsdomain": dnsdomain,
                    'username_mail': username_mail,
+                   # None unless mailboxes are sharded over several nodes
+                   "shard_ring": load_ring(params),
+                   "runtime_stats_dir": runtime_stats_dir,
+                   "rop_stats_dir": rop_stats_dir,
     }
 
     # OpenChange dispatcher DB names
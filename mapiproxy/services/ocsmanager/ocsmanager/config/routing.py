@@ -24,6 +24,12 @@ def make_map(config):
                 conditions={'method': ["GET", "POST"]})
     map.connect('/ews/oab.xml', controller="oab", action="head_oab",
                 conditions={'method': ["HEAD"]})
+    map.connect('/ews/oab/oab.xml', controller="oab", action="get_oab",
+                conditions={'method': ["GET", "POST"]})
+    map.connect('/ews/oab/oab.xml', controller="oab", action="head_oab",
+                conditions={'method': ["HEAD"]})
+    map.connect('/ews/oab/{filename}', controller="oab", action="get_file",
+                conditions={'method': ["GET", "HEAD"]})
     map.connect('/ews/{controller}')
     map.connect('/ews/{controller}.wsdl')
     map.connect('/{controller}/{action}')
@@ -32,4 +38,7 @@ def make_map(config):
     # RPC over HTTP
     map.connect('/rpc/rpcproxy.dll', controller='rpcproxy')
 
+    # Prometheus scrapes
+    map.connect('/metrics', controller='metrics', action='index')
+
     return map
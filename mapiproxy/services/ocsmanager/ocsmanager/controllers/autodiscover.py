@@ -21,8 +21,10 @@
 This module provides an implementation of the HTTP autodiscover protocol. [MS-OXDSCLI]
 """
 from cStringIO import StringIO
+from hashlib import md5
 import socket
 import struct
+import threading
 from time import time, strftime, localtime
 import traceback
 import urllib
@@ -49,6 +51,50 @@ RESPONSEA_XMLNS = ("http://schemas.microsoft.com/exchange/autodiscover/outlook"
 # NOTE: the use of this module requires proper configuration of either SCP or
 # the SRV field for "_Autodiscover._tcp" in the name service. See MS-OXDISCO.
 
+# Most cached users kept
+USER_CACHE_SIZE = 10000
+
+
+class _UserCache(object):
+    """Users found in SAMDB, keyed by the LegacyDN or e-mail address
+    requested. Unknown addresses are remembered as well, for a shorter
+    time, so that misconfigured clients retrying in a loop do not reach
+    SAMDB either.
+
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.entries = {}
+
+    def get(self, key, now):
+        with self.lock:
+            entry = self.entries.get(key)
+            if entry is None:
+                return (False, None)
+            (expires, user) = entry
+            if expires <= now:
+                del self.entries[key]
+                return (False, None)
+            return (True, user)
+
+    def put(self, key, user, ttl, now):
+        if ttl <= 0:
+            return
+        with self.lock:
+            if len(self.entries) >= USER_CACHE_SIZE:
+                # drop the expired entries, everything if none is
+                for (old_key, (expires, old_user)) in self.entries.items():
+                    if expires <= now:
+                        del self.entries[old_key]
+                if len(self.entries) >= USER_CACHE_SIZE:
+                    self.entries.clear()
+            self.entries[key] = (now + ttl, user)
+
+
+_user_cache = _UserCache()
+_deployment_id = None
+
 
 class AutodiscoverHandler(object):
     """This class parses the XML request, interprets it, find the requested
@@ -109,6 +155,43 @@ class AutodiscoverHandler(object):
                 new_element.text = value
             top_element.append(new_element)
 
+    def _cache_key(self):
+        if "LegacyDN" in self.request:
+            return ("LegacyDN", (self.request["LegacyDN"] or "").lower())
+        elif "EMailAddress" in self.request:
+            return ("EMailAddress", (self.request["EMailAddress"] or "").lower())
+        return None
+
+    def _fetch_user(self):
+        """Returns what the response needs from the user records,
+        from the cache when it is there.
+
+        """
+        autodiscover_conf = config['ocsmanager']['autodiscover']
+        key = self._cache_key()
+        now = time()
+        if key is not None:
+            (found, user) = _user_cache.get(key, now)
+            if found:
+                return user
+
+        ldb_record = self._fetch_user_ldb_record()
+        if ldb_record is None:
+            user = None
+            ttl = autodiscover_conf['negative_cache_ttl']
+        else:
+            user = {"record": self._get_user_record(ldb_record),
+                    "mdb_dn": self._fetch_mdb_dn(ldb_record),
+                    "owner": None}
+            if "sAMAccountName" in ldb_record:
+                user["owner"] = ldb_record["sAMAccountName"][0]
+            ttl = autodiscover_conf['cache_ttl']
+
+        if key is not None:
+            _user_cache.put(key, user, ttl, now)
+
+        return user
+
     def _fetch_user_ldb_record(self):
         samdb = config["samba"]["samdb_ldb"]
 
@@ -133,6 +216,13 @@ class AutodiscoverHandler(object):
         return ldb_record
 
     def _fill_deployment_id(self, record):
+        global _deployment_id
+
+        # the first organization does not change
+        if _deployment_id is not None:
+            record["DeploymentId"] = _deployment_id
+            return
+
         samdb = config["samba"]["samdb_ldb"]
 
         # fetch first org data
@@ -142,7 +232,8 @@ class AutodiscoverHandler(object):
             ldb_record = res[0]
             if "objectGUID" in ldb_record:
                 guid = uuid.UUID(bytes=ldb_record["objectGUID"][0])
-                record["DeploymentId"] = str(guid)
+                _deployment_id = str(guid)
+                record["DeploymentId"] = _deployment_id
 
         # TODO: handle invalid nbr of records
 
@@ -217,9 +308,9 @@ class AutodiscoverHandler(object):
 
         return available_proto
 
-    def _append_user_found_response(self, resp_element, ldb_record):
+    def _append_user_found_response(self, resp_element, user):
         #TODO: check user_record
-        response_tree = {"User": self._get_user_record(ldb_record)}
+        response_tree = {"User": user["record"]}
         self._append_elements(resp_element, response_tree)
 
         account_element = Element("Account")
@@ -228,7 +319,14 @@ class AutodiscoverHandler(object):
         self._append_elements(account_element, {"AccountType": "email",
                                                 "Action": "settings"})
 
-        mdb_dn = self._fetch_mdb_dn(ldb_record)
+        mdb_dn = user["mdb_dn"]
+
+        # The RPC server is the node serving the mailbox when mailboxes
+        # are sharded, rpcproxy connects to it as well
+        rpc_server_name = self.http_server_name
+        shard_ring = config["samba"].get("shard_ring")
+        if shard_ring is not None and user["owner"] is not None:
+            rpc_server_name = shard_ring.lookup(user["owner"])
 
         # Get the available and prioritised protocols depending on
         # the request and the configuration
@@ -247,7 +345,7 @@ class AutodiscoverHandler(object):
                  "ServerDN": config["samba"]["legacyserverdn"],
                  "ServerVersion": "720082AD",  # TODO: that is from ex2010
                  "MdbDN": mdb_dn,
-                 "Server": self.http_server_name,
+                 "Server": rpc_server_name,
                  "ASUrl": "https://%s/ews/as"
                  % self.http_server_name,  # availability
                  "OOFUrl": "https://%s/ews/oof"
@@ -339,7 +437,8 @@ class AutodiscoverHandler(object):
         """The method the actually performs the class's parsing and
         interpretation work.
 
-        Returns a fully formatted XML response.
+        Returns a fully formatted XML response, and whether it is a
+        successful one.
         """
 
         ## TODO:
@@ -350,20 +449,22 @@ class AutodiscoverHandler(object):
         resp_element = Element("Response")
         top_element.append(resp_element)
 
+        found = False
         if self.request is not None:
-            ldb_record = self._fetch_user_ldb_record()
+            user = self._fetch_user()
 
-            if ldb_record is None:
+            if user is None:
                 self._append_error(resp_element, 500)
             else:
+                found = True
                 resp_element.set("xmlns", RESPONSEA_XMLNS)
-                self._append_user_found_response(resp_element, ldb_record)
+                self._append_user_found_response(resp_element, user)
         else:
             self._append_error(resp_element, 600)
 
         body = ("<?xml version='1.0' encoding='utf-8'?>\n"
                 + tostring(top_element, "utf-8"))
-        return body
+        return (body, found)
 
 
 class AutodiscoverController(BaseController):
@@ -380,7 +481,21 @@ class AutodiscoverController(BaseController):
 
             rqh = AutodiscoverHandler(request, environ)
             response.headers["content-type"] = "application/xml"
-            body = rqh.response()
+            (body, found) = rqh.response()
+            if found:
+                # Clients reconnecting all at once revalidate instead
+                # of downloading the same settings again
+                etag = '"%s"' % md5(body).hexdigest()
+                ttl = config['ocsmanager']['autodiscover']['cache_ttl']
+                response.headers["ETag"] = etag
+                response.headers["Cache-Control"] = "private, max-age=%d" % ttl
+                if_none_match = request.headers.get("If-None-Match", "")
+                if etag in [tag.strip() for tag in if_none_match.split(",")]:
+                    response.status = 304
+                    body = ""
+            else:
+                # errors carry the time they happened at
+                response.headers["Cache-Control"] = "no-cache"
         except:
             response.status = 500
             response.headers["content-type"] = "text/plain"
@@ -0,0 +1,42 @@
+# -*- coding: utf-8 -*-
+#
+# Copyright (C) OpenChange Project 2015
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+This module exports the runtime statistics of the OpenChange server
+processes to Prometheus. The files are read on every scrape.
+"""
+from pylons import config, response
+from pylons.controllers.util import abort
+from pylons.decorators.rest import restrict
+
+from ocsmanager.lib.base import BaseController
+from ocsmanager.lib.stats import Stats, render
+
+
+class MetricsController(BaseController):
+    """The controller class for Prometheus scrapes."""
+
+    @restrict('GET')
+    def index(self, **kwargs):
+        if not config['ocsmanager']['metrics']['enabled']:
+            abort(404)
+
+        stats = Stats()
+        stats.load(config['samba']['runtime_stats_dir'], config['samba']['rop_stats_dir'])
+
+        response.headers['Content-Type'] = 'text/plain; version=0.0.4; charset=utf-8'
+        return render(stats)
@@ -16,18 +16,31 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #
 """
-This module provides the retrieval of the offline address book. 
-For now only an empty address book is retrieved
+This module provides the retrieval of the offline address book.
+The manifest and OAB files are generated by ocsmanager.lib.oab and
+served as static files. An empty address book is retrieved until they
+are generated.
 """
+import os
+
+from paste.fileapp import FileApp
+from pylons.controllers.util import abort, forward
 from pylons.decorators.rest import restrict
-from pylons import response
+from pylons import config, response
 from ocsmanager.lib.base import BaseController
+from ocsmanager.lib.oab import OAB_MANIFEST, OAB_FILE_RE
 
 class OabController(BaseController):
     """The constroller class for OAB requests."""
 
+    def _oab_path(self, filename):
+        return os.path.join(config['ocsmanager']['oab']['path'], filename)
+
     def get_oab(self, **kwargs):
-        # TODO
+        manifest = self._oab_path(OAB_MANIFEST)
+        if os.path.isfile(manifest):
+            return forward(FileApp(manifest, content_type="application/xml"))
+
         response.headers["content-type"] = "application/xml"
         body = """<?xml version="1.0" encoding="UTF-8"?>
         <OAB>
@@ -35,5 +48,15 @@ class OabController(BaseController):
         return body
 
     def head_oab(self, **kwargs):
-        # TODO
-        pass
+        manifest = self._oab_path(OAB_MANIFEST)
+        if os.path.isfile(manifest):
+            return forward(FileApp(manifest, content_type="application/xml"))
+
+    def get_file(self, filename, **kwargs):
+        # Only serve the files the generator produced
+        if not OAB_FILE_RE.match(filename):
+            abort(404)
+        path = self._oab_path(filename)
+        if not os.path.isfile(path):
+            abort(404)
+        return forward(FileApp(path, content_type="application/octet-stream"))
@@ -32,6 +32,9 @@ import re
 import shutil
 import string
 import json
+import tempfile
+import threading
+from time import time
 
 from pylons import request, response
 from pylons.decorators.rest import restrict
@@ -143,6 +146,151 @@ class DbException(Exception):
     pass
 
 
+# Most cached user records and mailboxes kept
+OOF_CACHE_SIZE = 10000
+# Seconds between two checks of a sieve script for changes
+SIEVE_CHECK_INTERVAL = 1
+
+
+class _RecordCache(object):
+    """SAMDB records of the users, keyed by the search filter. Outlook
+    polls the OOF settings, the owner of the mailbox is only searched
+    for once per cache_ttl.
+
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.entries = {}
+
+    def get(self, key, now):
+        with self.lock:
+            entry = self.entries.get(key)
+            if entry is None:
+                return None
+            (expires, record) = entry
+            if expires <= now:
+                del self.entries[key]
+                return None
+            return record
+
+    def put(self, key, record, ttl, now):
+        if ttl <= 0:
+            return
+        with self.lock:
+            if len(self.entries) >= OOF_CACHE_SIZE:
+                # drop the expired entries, everything if none is
+                for (old_key, (expires, old_record)) in self.entries.items():
+                    if expires <= now:
+                        del self.entries[old_key]
+                if len(self.entries) >= OOF_CACHE_SIZE:
+                    self.entries.clear()
+            self.entries[key] = (now + ttl, record)
+
+
+class _SettingsCache(object):
+    """OOF settings parsed from the sieve script of each mailbox.
+
+    An entry is valid while the script is unchanged, which the file
+    backend checks at most once per SIEVE_CHECK_INTERVAL. Backends that
+    cannot tell when the script changed keep the settings for
+    cache_ttl.
+
+    """
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.entries = {}
+
+    def get(self, mailbox, backend, now):
+        with self.lock:
+            entry = self.entries.get(mailbox)
+        if entry is None:
+            return None
+
+        (stamp, checked, expires, settings) = entry
+        if stamp is None:
+            if expires <= now:
+                self.invalidate(mailbox)
+                return None
+        elif now - checked >= SIEVE_CHECK_INTERVAL:
+            if backend.stamp(mailbox) != stamp:
+                self.invalidate(mailbox)
+                return None
+            with self.lock:
+                if self.entries.get(mailbox) is entry:
+                    self.entries[mailbox] = (stamp, now, expires, settings)
+        return dict(settings)
+
+    def put(self, mailbox, stamp, settings, ttl, now):
+        if ttl <= 0:
+            return
+        with self.lock:
+            if len(self.entries) >= OOF_CACHE_SIZE:
+                self.entries.clear()
+            self.entries[mailbox] = (stamp, now, now + ttl, dict(settings))
+
+    def invalidate(self, mailbox):
+        with self.lock:
+            self.entries.pop(mailbox, None)
+
+
+class _SettingsWriter(object):
+    """Writes the sieve scripts of the OOF settings set by the clients
+    in the background. Only the last settings set for a mailbox are
+    written, and they are served to the clients until then.
+
+    """
+
+    def __init__(self):
+        self.cond = threading.Condition()
+        self.pending = {}
+        self.thread = None
+
+    def get(self, mailbox):
+        with self.cond:
+            oof = self.pending.get(mailbox)
+            if oof is None:
+                return None
+            return dict(oof._config)
+
+    def put(self, mailbox, oof):
+        with self.cond:
+            self.pending[mailbox] = oof
+            if self.thread is None:
+                self.thread = threading.Thread(target=self._run,
+                                               name='oof-writer')
+                self.thread.daemon = True
+                self.thread.start()
+            self.cond.notify()
+
+    def _run(self):
+        while True:
+            with self.cond:
+                while not self.pending:
+                    self.cond.wait()
+                (mailbox, oof) = self.pending.items()[0]
+
+            try:
+                oof.to_sieve(mailbox)
+                _settings_cache.put(mailbox, oof.backend.stamp(mailbox),
+                                    oof._config, oof.cache_ttl, time())
+            except Exception as e:
+                log.error("Cannot store OOF settings for %s: %s" %
+                          (mailbox, e))
+                _settings_cache.invalidate(mailbox)
+
+            with self.cond:
+                # Settings set again while writing are written next
+                if self.pending.get(mailbox) is oof:
+                    del self.pending[mailbox]
+
+
+_record_cache = _RecordCache()
+_settings_cache = _SettingsCache()
+_settings_writer = _SettingsWriter()
+
+
 class OofHandler(object):
     """
     This class parses the XML request, interprets it, find the requested
@@ -217,6 +365,11 @@ class OofHandler(object):
         """
         Fetch a record from LDB
         """
+        now = time()
+        ldb_record = _record_cache.get(ldb_filter, now)
+        if ldb_record is not None:
+            return ldb_record
+
         samdb = config["samba"]["samdb_ldb"]
         base_dn = config["samba"]["domaindn"]
         res = samdb.search(base=base_dn, scope=ldb.SCOPE_SUBTREE,
@@ -227,6 +380,9 @@ class OofHandler(object):
             raise DbException('Error fetching database entry. Expected '
                               'one result but got %s' % len(res))
 
+        _record_cache.put(ldb_filter, ldb_record,
+                          config['ocsmanager']['outofoffice']['cache_ttl'],
+                          now)
         return ldb_record
 
     def check_mailbox(self, request_mailbox):
@@ -358,8 +514,8 @@ class OofHandler(object):
 
         # Retrieve OOF settings
         oof = OofSettings()
-        log.debug("Loading OOF settings from sieve script")
-        oof.from_sieve(mailbox)
+        log.debug("Loading OOF settings")
+        oof.load(mailbox)
 
         # Build the command response
         response_element = Element("{%s}GetUserOofSettingsResponse" %
@@ -420,9 +576,9 @@ class OofHandler(object):
             # Set settings
             oof = OofSettings()
             # Retrieve stored settings
-            oof.from_sieve(mailbox)
+            oof.load(mailbox)
             oof.from_xml(settings_element)
-            oof.to_sieve(mailbox)
+            oof.save(mailbox)
         except Exception as e:
             log.exception(e)
             response_message_element.set('ResponseClass', 'Error')
@@ -476,6 +632,7 @@ class OofSettings(object):
 
         # Read configuration
         oof_conf = config['ocsmanager']['outofoffice']
+        self.cache_ttl = oof_conf['cache_ttl']
         if oof_conf['backend'] in ('file', 'managesieve'):
             backend_conf = config['ocsmanager']['outofoffice:%s' % oof_conf['backend']]
             backend_class_name = 'Oof%sBackend' % oof_conf['backend'].title()
@@ -491,6 +648,34 @@ class OofSettings(object):
         """
         return json.dumps(self._config)
 
+    def load(self, mailbox):
+        """
+        Loads OOF settings for specified mailbox, from the settings
+        cache unless its sieve script changed
+
+        :param str mailbox: the user's mailbox
+        """
+        settings = _settings_writer.get(mailbox)
+        if settings is None:
+            settings = _settings_cache.get(mailbox, self.backend, time())
+        if settings is not None:
+            self._config = settings
+            return
+
+        # Taken before reading, a change while reading is seen next time
+        stamp = self.backend.stamp(mailbox)
+        self.from_sieve(mailbox)
+        _settings_cache.put(mailbox, stamp, self._config, self.cache_ttl,
+                            time())
+
+    def save(self, mailbox):
+        """
+        Stores OOF settings for specified mailbox in the background
+
+        :param str mailbox: the user's mailbox
+        """
+        _settings_writer.put(mailbox, self)
+
     def from_sieve(self, mailbox):
         """
         Loads OOF settings for specified mailbox
@@ -716,6 +901,47 @@ class OofFileBackend(object):
     def __init__(self, **conf):
         self.conf = conf
 
+    def _expand_sieve_path(self, mailbox):
+        """Expand the sieve script path template for a mailbox
+
+        :returns: the path of the OOF sieve script and the active sieve
+                  script path if required
+        :rtype: tuple
+        """
+        sieve_script_path_template = self.conf['sieve_script_path']
+
+        # Build the expansion variables for template
+        (user, domain) = mailbox.split('@')
+
+        # Substitute in template
+        t = Template(sieve_script_path_template)
+        sieve_script_path = t.substitute(domain=domain, user=user,
+                                         fulluser=mailbox)
+
+        active_sieve_script_path = None
+        (head, tail) = os.path.split(sieve_script_path)
+        if tail == 'sieve-script':  # Dovecot only?
+            active_sieve_script_path = sieve_script_path
+            sieve_script_path = os.path.join(head, SIEVE_SCRIPT_NAME + '.sieve')
+
+        return (sieve_script_path, active_sieve_script_path)
+
+    def stamp(self, mailbox):
+        """Identify the current version of the OOF sieve script.
+
+        Unlike load, nothing is created or backed up.
+
+        :param str mailbox: the mailbox user
+        :returns: a value that changes whenever the script changes
+        :rtype: tuple
+        """
+        (sieve_script_path, _) = self._expand_sieve_path(mailbox)
+        try:
+            sinfo = os.stat(sieve_script_path)
+        except OSError:
+            return ()
+        return (sinfo.st_ino, sinfo.st_mtime, sinfo.st_size)
+
     def _sieve_path(self, mailbox):
         """Retrieve the sieve script path for a mailbox
 
@@ -819,15 +1045,25 @@ class OofFileBackend(object):
         sinfo = os.stat(head)
         if isinstance(script, unicode):
             script = script.encode('utf8')
-        with open(sieve_script_path, 'w') as f:
-            f.write(script)
-            os.chmod(sieve_script_path, 0755)
-            os.chown(sieve_script_path, sinfo.st_uid, sinfo.st_gid)
+        # Rename a complete copy over the script, so that it is never
+        # read half written
+        (fd, tmp_path) = tempfile.mkstemp(dir=head, prefix='.' + tail)
+        try:
+            with os.fdopen(fd, 'w') as f:
+                f.write(script)
+            os.chmod(tmp_path, 0755)
+            os.chown(tmp_path, sinfo.st_uid, sinfo.st_gid)
+            os.rename(tmp_path, sieve_script_path)
+        except:
+            os.unlink(tmp_path)
+            raise
 
         if active_sieve_script_path:
-            if os.path.exists(active_sieve_script_path):
-                os.unlink(active_sieve_script_path)
-            os.symlink(os.path.basename(sieve_script_path), active_sieve_script_path)
+            tmp_link = active_sieve_script_path + '.tmp'
+            if os.path.lexists(tmp_link):
+                os.unlink(tmp_link)
+            os.symlink(os.path.basename(sieve_script_path), tmp_link)
+            os.rename(tmp_link, active_sieve_script_path)
 
         return sieve_user_path
 
@@ -858,6 +1094,16 @@ class OofManagesieveBackend(object):
         self.ssl = ssl
         self.passwd = secret
 
+    def stamp(self, mailbox):
+        """Identify the current version of the OOF sieve script.
+
+        The server cannot tell without downloading the script, the
+        settings are kept for cache_ttl instead.
+
+        :param str mailbox: the mailbox user
+        """
+        return None
+
     def user_script(self, mailbox):
         """Return the user active sieve script if it is different from out of
         office.
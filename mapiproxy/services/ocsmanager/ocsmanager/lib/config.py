@@ -86,6 +86,21 @@ class OCSConfig(object):
 
         self.d[section][option] = cfg_option
 
+    def __get_int_option(self, section=None, option=None, dflt=None):
+        if dflt is None and not self.cfg.has_option(section, option):
+            log.error("%s: Missing %s option in [%s] section", self.config, option, section)
+            sys.exit()
+
+        if dflt is not None and not self.cfg.has_option(section, option):
+            cfg_option = dflt
+        else:
+            cfg_option = self.cfg.getint(section, option)
+
+        if section not in self.d:
+            self.d[section] = {}
+
+        self.d[section][option] = cfg_option
+
     def __get_list_option(self, section=None, option=None, dflt=None, delimiter=',\s*'):
         if dflt is None and not self.cfg.has_option(section, option):
             log.error("%s: Missing %s option in [%s] section", self.config, option, section)
@@ -152,6 +167,8 @@ class OCSConfig(object):
     def __parse_autodiscover(self):
         self.__get_section('autodiscover')
         self.__get_list_option('autodiscover', 'internal_networks', dflt=['0.0.0.0/0'])
+        self.__get_int_option('autodiscover', 'cache_ttl', dflt=300)
+        self.__get_int_option('autodiscover', 'negative_cache_ttl', dflt=60)
 
     def __parse_autodiscover_rpcproxy(self):
         self.__get_section('autodiscover:rpcproxy')
@@ -164,6 +181,7 @@ class OCSConfig(object):
         self.__get_section('outofoffice')
 
         self.__get_option('outofoffice', 'backend', dflt='file')
+        self.__get_int_option('outofoffice', 'cache_ttl', dflt=300)
 
         if self.d['outofoffice']['backend'] == 'file':
             self.__get_option('outofoffice:file', 'sieve_script_path')
@@ -177,6 +195,13 @@ class OCSConfig(object):
             log.error('Invalid outofoffice backend: %s' % self.d['outofoffice']['backend'])
             sys.exit()
 
+    def __parse_oab(self):
+        self.__get_option('oab', 'path', dflt='/var/lib/ocsmanager/oab')
+
+    def __parse_metrics(self):
+        self.__get_option('metrics', 'enabled', dflt='true')
+        self.d['metrics']['enabled'] = self.d['metrics']['enabled'] in (True, 'true', 'yes', 'on', '1')
+
     def load(self):
         """Load the configuration file.
         """
@@ -199,5 +224,7 @@ class OCSConfig(object):
         self.__parse_autodiscover()
         self.__parse_autodiscover_rpcproxy()
         self.__parse_outofoffice()
+        self.__parse_oab()
+        self.__parse_metrics()
 
         return self.d
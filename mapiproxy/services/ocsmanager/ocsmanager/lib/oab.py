@@ -0,0 +1,398 @@
+# -*- coding: utf-8 -*-
+#
+# Copyright (C) 2015  OpenChange Project
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Offline Address Book generation.
+
+The Global Address List is read from SAMDB and written as an OAB
+version 4 full details file [MS-OXOAB], wrapped in the block format
+of compressed OAB files. The files and the oab.xml manifest
+[MS-OXWOAB] are written to a directory the oab controller serves as
+static files, so Outlook in cached mode has no reason to browse the
+GAL through NSPI.
+
+Run it periodically, for instance daily from cron:
+
+    python -m ocsmanager.lib.oab /etc/ocsmanager/ocsmanager.ini
+"""
+import hashlib
+import logging
+import os
+import re
+import struct
+import sys
+import tempfile
+import uuid
+import zlib
+
+from xml.etree.ElementTree import Element, SubElement, tostring
+
+log = logging.getLogger(__name__)
+
+# OAB_HDR ulVersion of version 4 full details files
+OAB_VERSION_4 = 0x00000020
+# Version of the compressed files header
+OAB_COMPRESSED_VERSION_HI = 3
+OAB_COMPRESSED_VERSION_LO = 1
+# Size of the blocks of compressed files
+OAB_BLOCK_MAX = 0x40000
+
+# OAB_PROP_REC ulFlags
+OAB_ANR = 0x1
+OAB_RDN = 0x2
+OAB_INDEX = 0x4
+
+# Property types
+PT_LONG = 0x0003
+PT_BOOLEAN = 0x000B
+PT_STRING8 = 0x001E
+PT_UNICODE = 0x001F
+PT_BINARY = 0x0102
+MV_FLAG = 0x1000
+
+# Header record properties
+PidTagOfflineAddressBookName = 0x6800001F
+PidTagOfflineAddressBookSequence = 0x68010003
+PidTagOfflineAddressBookContainerGuid = 0x6802001E
+PidTagOfflineAddressBookDistinguishedName = 0x6804001E
+
+OAB_HDR_ATTS = [
+    (PidTagOfflineAddressBookName, 0),
+    (PidTagOfflineAddressBookDistinguishedName, 0),
+    (PidTagOfflineAddressBookSequence, 0),
+    (PidTagOfflineAddressBookContainerGuid, 0),
+]
+
+# Record properties: (ulPropID, ulFlags, LDB attribute)
+OAB_ATTS = [
+    (0x3001001F, OAB_ANR | OAB_INDEX, 'displayName'),        # PidTagDisplayName
+    (0x39FE001F, OAB_ANR, 'mail'),                           # PidTagSmtpAddress
+    (0x3003001E, OAB_RDN, 'legacyExchangeDN'),               # PidTagEmailAddress
+    (0x800F101F, 0, 'proxyAddresses'),                       # PidTagAddressBookProxyAddresses
+    (0x3A00001F, OAB_ANR, 'sAMAccountName'),                 # PidTagAccount
+    (0x3A06001F, OAB_ANR, 'givenName'),                      # PidTagGivenName
+    (0x3A11001F, OAB_ANR, 'sn'),                             # PidTagSurname
+    (0x3A17001F, 0, 'title'),                                # PidTagTitle
+    (0x3A18001F, 0, 'department'),                           # PidTagDepartmentName
+    (0x3A16001F, 0, 'company'),                              # PidTagCompanyName
+    (0x3A19001F, OAB_ANR, 'physicalDeliveryOfficeName'),     # PidTagOfficeLocation
+    (0x3A08001F, 0, 'telephoneNumber'),                      # PidTagBusinessTelephoneNumber
+    (0x3A1C001F, 0, 'mobile'),                               # PidTagMobileTelephoneNumber
+    (0x8C6D0102, 0, 'objectGUID'),                           # PidTagAddressBookObjectGuid
+    (0x0FFE0003, 0, None),                                   # PidTagObjectType
+    (0x39000003, 0, None),                                   # PidTagDisplayType
+]
+
+# Values of the properties not stored in the directory
+MAPI_MAILUSER = 0x6
+DT_MAILUSER = 0x0
+
+OAB_MANIFEST = 'oab.xml'
+OAB_FILE_RE = re.compile(r'^[0-9a-f-]+-\d+\.lzx$')
+
+
+def oab_crc(data, crc=0xFFFFFFFF):
+    """CRC-32 as specified by [MS-OXOAB]: seeded with 0xFFFFFFFF and
+    without the final inversion zlib applies."""
+    return ~zlib.crc32(data, ~crc & 0xFFFFFFFF) & 0xFFFFFFFF
+
+
+def pack_integer(value):
+    """Encode an integer with the OAB compressed format: values up to
+    0x7F use one byte, others a byte count followed by little endian
+    bytes."""
+    value &= 0xFFFFFFFF
+    if value <= 0x7F:
+        return struct.pack('<B', value)
+    data = struct.pack('<I', value).rstrip('\x00')
+    return struct.pack('<B', 0x80 | len(data)) + data
+
+
+def _pack_single(proptype, value):
+    if proptype == PT_LONG:
+        return pack_integer(value)
+    if proptype == PT_BOOLEAN:
+        return struct.pack('<B', 1 if value else 0)
+    if proptype in (PT_STRING8, PT_UNICODE):
+        # Both string types are stored UTF-8 encoded and null terminated
+        if isinstance(value, unicode):
+            value = value.encode('utf-8')
+        return value + '\x00'
+    if proptype == PT_BINARY:
+        return pack_integer(len(value)) + value
+    raise ValueError('Unsupported property type 0x%.4x' % proptype)
+
+
+def pack_value(proptag, value):
+    """Encode a property value of an OAB record."""
+    proptype = proptag & 0xFFFF
+    if proptype & MV_FLAG:
+        return pack_integer(len(value)) + ''.join(
+            _pack_single(proptype & ~MV_FLAG, v) for v in value)
+    return _pack_single(proptype, value)
+
+
+def pack_record(atts, values):
+    """Encode an OAB_V4_REC: its size, the presence bit array of the
+    properties and the values of the present ones.
+
+    atts is the list of property tags of the record kind, values a
+    dictionary of the values by property tag."""
+    presence = bytearray((len(atts) + 7) / 8)
+    data = []
+    for i, proptag in enumerate(atts):
+        value = values.get(proptag)
+        if value is None or value == [] or value == '':
+            continue
+        presence[i / 8] |= 0x80 >> (i % 8)
+        data.append(pack_value(proptag, value))
+    body = str(presence) + ''.join(data)
+    return struct.pack('<I', len(body) + 4) + body
+
+
+def pack_prop_table(atts):
+    """Encode an OAB_PROP_TABLE."""
+    return struct.pack('<I', len(atts)) + ''.join(
+        struct.pack('<II', proptag, flags) for (proptag, flags) in atts)
+
+
+def pack_metadata():
+    """Encode the OAB_META_DATA record describing the header and the
+    records properties."""
+    body = (pack_prop_table(OAB_HDR_ATTS) +
+            pack_prop_table([(proptag, flags) for (proptag, flags, _) in OAB_ATTS]))
+    return struct.pack('<I', len(body) + 4) + body
+
+
+def ldb_record_values(record):
+    """Map an LDB record to the values of an OAB record."""
+    values = {}
+    for (proptag, _, attr) in OAB_ATTS:
+        if attr is None or attr not in record:
+            continue
+        el = record[attr]
+        if proptag & MV_FLAG:
+            values[proptag] = [str(v).decode('utf-8') for v in el]
+        elif (proptag & 0xFFFF) == PT_BINARY:
+            values[proptag] = str(el[0])
+        else:
+            values[proptag] = str(el[0]).decode('utf-8')
+    values[0x0FFE0003] = MAPI_MAILUSER
+    values[0x39000003] = DT_MAILUSER
+    return values
+
+
+class OABWriter(object):
+    """Write an OAB version 4 full details file, record by record, in
+    the block format of compressed OAB files.
+
+    Blocks are stored uncompressed (ulFlags = 0), which every client
+    accepts, so no LZX encoder is needed."""
+
+    def __init__(self, fileobj, name, dn, guid, sequence, count):
+        self.fileobj = fileobj
+        self.buffer = []
+        self.buffered = 0
+        self.size = 0
+        self.crc = 0xFFFFFFFF
+
+        self._write_raw(struct.pack('<IIII', OAB_COMPRESSED_VERSION_HI,
+                                    OAB_COMPRESSED_VERSION_LO, OAB_BLOCK_MAX, 0))
+
+        # OAB_HDR, ulSerial is the CRC of what follows and is patched
+        # by close()
+        self.write(struct.pack('<III', OAB_VERSION_4, 0, count))
+        self.write(pack_metadata())
+        header_atts = [proptag for (proptag, _) in OAB_HDR_ATTS]
+        self.write(pack_record(header_atts, {
+            PidTagOfflineAddressBookName: name,
+            PidTagOfflineAddressBookDistinguishedName: dn,
+            PidTagOfflineAddressBookSequence: sequence,
+            PidTagOfflineAddressBookContainerGuid: guid,
+        }))
+
+    def _write_raw(self, data):
+        self.fileobj.write(data)
+
+    def write(self, data):
+        self.buffer.append(data)
+        self.buffered += len(data)
+        if self.size >= 12:
+            self.crc = oab_crc(data, self.crc)
+        else:
+            # The OAB_HDR is not part of the CRC
+            skip = 12 - self.size
+            if len(data) > skip:
+                self.crc = oab_crc(data[skip:], self.crc)
+        self.size += len(data)
+        while self.buffered >= OAB_BLOCK_MAX:
+            self._flush_block(OAB_BLOCK_MAX)
+
+    def _flush_block(self, length):
+        data = ''.join(self.buffer)
+        block, rest = data[:length], data[length:]
+        self.buffer = [rest] if rest else []
+        self.buffered = len(rest)
+        self._write_raw(struct.pack('<IIII', 0, len(block), len(block), oab_crc(block)))
+        self._write_raw(block)
+
+    def write_record(self, values):
+        self.write(pack_record([proptag for (proptag, _, _) in OAB_ATTS], values))
+
+    def close(self):
+        """Flush the pending data and return the uncompressed size and
+        the CRC to store as ulSerial, see _patch_serial."""
+        if self.buffered:
+            self._flush_block(self.buffered)
+        return (self.size, self.crc)
+
+
+def _patch_serial(path, crc):
+    """Write the OAB_HDR ulSerial and fix the CRC of the first block."""
+    with open(path, 'r+b') as f:
+        f.seek(16)
+        (flags, comp_size, uncomp_size, _) = struct.unpack('<IIII', f.read(16))
+        block = bytearray(f.read(comp_size))
+        block[4:8] = struct.pack('<I', crc)
+        f.seek(16)
+        f.write(struct.pack('<IIII', flags, comp_size, uncomp_size, oab_crc(str(block))))
+        f.write(block)
+
+
+def _file_sha1(path):
+    sha = hashlib.sha1()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(65536), ''):
+            sha.update(chunk)
+    return sha.hexdigest()
+
+
+class OABGenerator(object):
+    """Produce the OAB files of the Global Address List in a directory."""
+
+    def __init__(self, samdb, domaindn, firstorg, path, keep=2):
+        self.samdb = samdb
+        self.domaindn = domaindn
+        self.firstorg = firstorg
+        self.path = path
+        self.keep = keep
+
+    def _gal(self):
+        import ldb
+        res = self.samdb.search(base=self.samdb.get_config_basedn(),
+                                scope=ldb.SCOPE_SUBTREE,
+                                expression='(globalAddressList=*)',
+                                attrs=['globalAddressList'])
+        if not len(res):
+            raise RuntimeError('No Global Address List found')
+        dn = res[0]['globalAddressList'][0]
+        res = self.samdb.search(base=dn, scope=ldb.SCOPE_BASE,
+                                attrs=['objectGUID', 'displayName', 'purportedSearch'])
+        return res[0]
+
+    def _read_manifest_sequence(self):
+        manifest = os.path.join(self.path, OAB_MANIFEST)
+        try:
+            with open(manifest) as f:
+                match = re.search(r'seq="(\d+)"', f.read())
+        except IOError:
+            return 0
+        return int(match.group(1)) if match else 0
+
+    def _cleanup(self, current):
+        files = [f for f in os.listdir(self.path) if OAB_FILE_RE.match(f)]
+        files.sort(key=lambda f: int(f.rsplit('-', 1)[1].split('.')[0]), reverse=True)
+        for name in files[self.keep:]:
+            if name != current:
+                os.unlink(os.path.join(self.path, name))
+
+    def generate(self):
+        """Write a new full OAB and its manifest, and return the path of
+        the OAB file."""
+        import ldb
+
+        gal = self._gal()
+        guid = str(uuid.UUID(bytes_le=str(gal['objectGUID'][0])))
+        name = '\\' + str(gal.get('displayName', ['Global Address List'])[0])
+        filter = '(&(legacyExchangeDN=/o=%s/ou=*)%s)' % (self.firstorg,
+                                                         gal['purportedSearch'][0])
+
+        records = self.samdb.search(base=self.domaindn, scope=ldb.SCOPE_SUBTREE,
+                                    expression=filter,
+                                    attrs=[attr for (_, _, attr) in OAB_ATTS if attr])
+        records = sorted(records, key=lambda r: str(r.get('displayName', [''])[0]).lower())
+
+        sequence = self._read_manifest_sequence() + 1
+        filename = '%s-%d.lzx' % (guid, sequence)
+        if not os.path.isdir(self.path):
+            os.makedirs(self.path)
+
+        (fd, tmp) = tempfile.mkstemp(dir=self.path, prefix='.oab')
+        with os.fdopen(fd, 'wb') as f:
+            writer = OABWriter(f, name, '/', guid, sequence, len(records))
+            for record in records:
+                writer.write_record(ldb_record_values(record))
+            (uncompressed_size, crc) = writer.close()
+        _patch_serial(tmp, crc)
+        os.chmod(tmp, 0644)
+        os.rename(tmp, os.path.join(self.path, filename))
+
+        self._write_manifest(guid, name, sequence, filename, uncompressed_size)
+        self._cleanup(filename)
+
+        log.info('OAB %s written with %d records', filename, len(records))
+        return os.path.join(self.path, filename)
+
+    def _write_manifest(self, guid, name, sequence, filename, uncompressed_size):
+        path = os.path.join(self.path, filename)
+        root = Element('OAB')
+        oal = SubElement(root, 'OAL', id=guid, dn='/', name=name)
+        full = SubElement(oal, 'Full', seq=str(sequence), ver=str(OAB_VERSION_4),
+                          size=str(os.path.getsize(path)),
+                          uncompressedsize=str(uncompressed_size),
+                          SHA=_file_sha1(path))
+        full.text = filename
+
+        (fd, tmp) = tempfile.mkstemp(dir=self.path, prefix='.oab')
+        with os.fdopen(fd, 'wb') as f:
+            f.write('<?xml version="1.0" encoding="UTF-8"?>\n')
+            f.write(tostring(root))
+        os.chmod(tmp, 0644)
+        os.rename(tmp, os.path.join(self.path, OAB_MANIFEST))
+
+
+def main(argv=None):
+    """Generate the OAB using the given ocsmanager configuration file."""
+    import ocsmanager.lib.config as OCSConfig
+    from ocsmanager.config.environment import _load_samba_environment
+
+    argv = argv or sys.argv
+    logging.basicConfig(level=logging.INFO)
+    if len(argv) != 2:
+        sys.stderr.write('Usage: %s ocsmanager.ini\n' % argv[0])
+        return 1
+
+    config = OCSConfig.OCSConfig(argv[1]).load()
+    samba = _load_samba_environment()
+    generator = OABGenerator(samba['samdb_ldb'], samba['domaindn'],
+                             samba['firstorg'], config['oab']['path'])
+    generator.generate()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
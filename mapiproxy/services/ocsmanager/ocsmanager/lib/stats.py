@@ -0,0 +1,307 @@
+# -*- coding: utf-8 -*-
+#
+# Copyright (C) OpenChange Project 2015
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Read the statistics files the OpenChange server processes update in
+place and render them in the Prometheus text exposition format.
+
+- mapiproxy-<pid>.stats (mapiproxy:runtime_stats): sessions, handles,
+  queued calls, notifications, indexing cache and mapistore backend
+  counters, see struct mapiproxy_stats in libmapiproxy.h.
+- emsmdb-<pid>.stats (emsmdb:rop_stats): ROP counters, session memory
+  and emsmdbp objects, see struct emsmdbp_stats.
+
+The values of all the live processes are summed: process identifiers
+change with every restart and would only add labels to the series.
+"""
+import errno
+import glob
+import os
+import struct
+
+RUNTIME_MAGIC = 0x4f43524d
+RUNTIME_VERSION = 1
+RUNTIME_HEADER = struct.Struct("=IIIIQ")
+MAPISTORE_HEADER = struct.Struct("=IIIIQQ")
+BACKEND_NAME_SIZE = 32
+
+# enum mapiproxy_stats_value: name, type, help
+RUNTIME_VALUES = (
+    ("openchange_emsmdb_sessions", "gauge", "EMSMDB sessions"),
+    ("openchange_nspi_sessions", "gauge", "NSPI sessions"),
+    ("openchange_mapi_handles", "gauge", "Records of the MAPI handle tables"),
+    ("openchange_emsmdb_queued_calls", "gauge", "EMSMDB calls waiting for a worker thread"),
+    ("openchange_emsmdb_notifications_total", "counter", "Notifications sent to EMSMDB clients"),
+    ("openchange_nspi_calls_total", "counter", "NSPI calls"),
+)
+
+# enum mapistore_backend_op, as named in the backend vtable
+BACKEND_OPS = (
+    "backend.list_contexts", "backend.create_context", "backend.create_root_folder",
+    "context.get_root_folder", "context.get_path",
+    "folder.open_folder", "folder.create_folder", "folder.delete", "folder.open_message",
+    "folder.create_message", "folder.delete_message", "folder.move_copy_messages",
+    "folder.move_folder", "folder.copy_folder", "folder.get_deleted_fmids",
+    "folder.get_changed_fmids", "folder.get_child_count", "folder.open_table",
+    "folder.modify_permissions", "folder.preload_message_bodies", "folder.set_read_flags",
+    "folder.delete_messages",
+    "message.get_message_data", "message.modify_recipients", "message.set_read_flag",
+    "message.save", "message.submit", "message.open_attachment", "message.create_attachment",
+    "message.get_attachment_table", "message.open_embedded_message",
+    "message.create_embedded_message",
+    "table.get_available_properties", "table.set_columns", "table.set_restrictions",
+    "table.set_sort_order", "table.get_row", "table.get_rows", "table.get_row_count",
+    "table.handle_destructor",
+    "properties.get_available_properties", "properties.get_properties",
+    "properties.set_properties", "properties.open_property_stream", "properties.copy_object",
+    "stream.read", "stream.write", "stream.commit",
+    "manager.generate_uri",
+)
+
+ROP_MAGIC = 0x4f435354
+ROP_VERSIONS = (1, 2, 3)
+ROP_HEADER = struct.Struct("=IIIIQ")
+ROPS = 256
+SESSIONS = 256
+OBJECT_TYPES = 16
+SESSION = struct.Struct("=IIQQ64s")
+OBJECT = struct.Struct("=QQ")
+OBJECT_NAMES = ("undefined", "mailbox", "folder", "message", "table", "stream",
+                "attachment", "subscription", "ftcontext", "synccontext")
+
+
+def _alive(pid):
+    try:
+        os.kill(pid, 0)
+    except OSError as e:
+        return e.errno != errno.ESRCH
+    return True
+
+
+def _read(path):
+    fh = open(path, 'rb')
+    try:
+        return fh.read()
+    finally:
+        fh.close()
+
+
+def _add_latency(entry, count, errors, usec, buckets):
+    if not entry:
+        entry.extend([0, 0, 0, [0] * len(buckets)])
+    entry[0] += count
+    entry[1] += errors
+    entry[2] += usec
+    entry[3] = [a + b for a, b in zip(entry[3], buckets)]
+
+
+class Stats(object):
+    """Sum of the statistics files of the live processes."""
+
+    def __init__(self):
+        self.processes = 0
+        self.values = [0] * len(RUNTIME_VALUES)
+        self.indexing = [0, 0]
+        self.backends = {}
+        self.rops = {}
+        self.session_memory = 0
+        self.objects = {}
+
+    def read_runtime(self, path):
+        data = _read(path)
+        if len(data) < RUNTIME_HEADER.size:
+            return False
+        magic, version, pid, count, started = RUNTIME_HEADER.unpack_from(data, 0)
+        if magic != RUNTIME_MAGIC or version != RUNTIME_VERSION or not _alive(pid):
+            return False
+
+        values = struct.Struct("=%dQ" % count)
+        offset = RUNTIME_HEADER.size
+        if len(data) < offset + values.size + MAPISTORE_HEADER.size:
+            return False
+        for i, value in enumerate(values.unpack_from(data, offset)[:len(RUNTIME_VALUES)]):
+            # Gauges are updated with signed deltas
+            if value >= 1 << 63:
+                value -= 1 << 64
+            self.values[i] += value
+
+        offset += values.size
+        backends, ops, nbuckets, reserved, hits, misses = MAPISTORE_HEADER.unpack_from(data, offset)
+        self.indexing[0] += hits
+        self.indexing[1] += misses
+
+        op = struct.Struct("=QQQQ%dQ" % nbuckets)
+        slot_size = BACKEND_NAME_SIZE + ops * op.size
+        offset += MAPISTORE_HEADER.size
+        if len(data) < offset + backends * slot_size:
+            return True
+        for i in range(backends):
+            slot = offset + i * slot_size
+            name = data[slot:slot + BACKEND_NAME_SIZE].split(b'\0', 1)[0].decode('utf-8', 'replace')
+            if not name:
+                continue
+            for opnum in range(ops):
+                values = op.unpack_from(data, slot + BACKEND_NAME_SIZE + opnum * op.size)
+                if not values[0]:
+                    continue
+                entry = self.backends.setdefault((name, opnum), [])
+                _add_latency(entry, values[0], values[1], values[2], values[4:])
+        return True
+
+    def read_rops(self, path):
+        data = _read(path)
+        if len(data) < ROP_HEADER.size:
+            return False
+        magic, version, pid, nbuckets, started = ROP_HEADER.unpack_from(data, 0)
+        if magic != ROP_MAGIC or version not in ROP_VERSIONS or not _alive(pid):
+            return False
+
+        rop = struct.Struct("=QQQQ%dQ" % nbuckets)
+        offset = ROP_HEADER.size + ROPS * rop.size
+        if len(data) < offset:
+            return False
+        for opnum in range(ROPS):
+            values = rop.unpack_from(data, ROP_HEADER.size + opnum * rop.size)
+            if values[0]:
+                _add_latency(self.rops.setdefault(opnum, []), values[0], values[1],
+                             values[2], values[4:])
+
+        if version >= 2 and len(data) >= offset + SESSIONS * SESSION.size:
+            for i in range(SESSIONS):
+                in_use, state, size, peak, username = SESSION.unpack_from(data, offset + i * SESSION.size)
+                if in_use:
+                    self.session_memory += size
+
+        offset += SESSIONS * SESSION.size
+        if version >= 3 and len(data) >= offset + OBJECT_TYPES * OBJECT.size:
+            for objtype in range(OBJECT_TYPES):
+                live, created = OBJECT.unpack_from(data, offset + objtype * OBJECT.size)
+                if created:
+                    entry = self.objects.setdefault(objtype, [0, 0])
+                    entry[0] += live
+                    entry[1] += created
+        return True
+
+    def load(self, runtime_dir, rop_dir):
+        """Read the files of the live processes found in the directories."""
+        processes = 0
+        for path in glob.glob(os.path.join(runtime_dir, "mapiproxy-*.stats")):
+            try:
+                if self.read_runtime(path):
+                    processes += 1
+            except (IOError, OSError, struct.error):
+                # The process exited meanwhile
+                continue
+        for path in glob.glob(os.path.join(rop_dir, "emsmdb-*.stats")):
+            try:
+                self.read_rops(path)
+            except (IOError, OSError, struct.error):
+                continue
+        self.processes = processes
+
+
+def _labels(labels):
+    if not labels:
+        return ""
+    return "{%s}" % ",".join('%s="%s"' % (k, str(v).replace('\\', '\\\\').replace('"', '\\"'))
+                             for k, v in labels)
+
+
+def _histogram(lines, name, labels, usec, buckets):
+    # Bucket 0 holds latencies under 1us, bucket b those under 2^b us
+    # and the last one everything above
+    seen = 0
+    for bucket, value in enumerate(buckets[:-1]):
+        seen += value
+        lines.append("%s_bucket%s %d" % (name, _labels(labels + [("le", "%.9g" % ((1 << bucket) / 1e6))]), seen))
+    seen += buckets[-1]
+    lines.append("%s_bucket%s %d" % (name, _labels(labels + [("le", "+Inf")]), seen))
+    lines.append("%s_sum%s %.6f" % (name, _labels(labels), usec / 1e6))
+    lines.append("%s_count%s %d" % (name, _labels(labels), seen))
+
+
+def _header(lines, name, kind, text):
+    lines.append("# HELP %s %s" % (name, text))
+    lines.append("# TYPE %s %s" % (name, kind))
+
+
+def render(stats):
+    """Return the statistics in the Prometheus text exposition format."""
+    lines = []
+
+    _header(lines, "openchange_processes", "gauge", "Server processes publishing runtime statistics")
+    lines.append("openchange_processes %d" % stats.processes)
+
+    for (name, kind, text), value in zip(RUNTIME_VALUES, stats.values):
+        _header(lines, name, kind, text)
+        lines.append("%s %d" % (name, max(value, 0)))
+
+    _header(lines, "openchange_indexing_cache_hits_total", "counter", "Indexing lookups served from the cache")
+    lines.append("openchange_indexing_cache_hits_total %d" % stats.indexing[0])
+    _header(lines, "openchange_indexing_cache_misses_total", "counter", "Indexing lookups sent to the backend")
+    lines.append("openchange_indexing_cache_misses_total %d" % stats.indexing[1])
+
+    if stats.backends:
+        _header(lines, "openchange_mapistore_backend_errors_total", "counter", "Failed mapistore backend calls")
+        for (backend, opnum) in sorted(stats.backends):
+            labels = [("backend", backend), ("op", _op_name(opnum))]
+            lines.append("openchange_mapistore_backend_errors_total%s %d"
+                         % (_labels(labels), stats.backends[(backend, opnum)][1]))
+        _header(lines, "openchange_mapistore_backend_latency_seconds", "histogram",
+                "Latency of the mapistore backend calls")
+        for (backend, opnum) in sorted(stats.backends):
+            count, errors, usec, buckets = stats.backends[(backend, opnum)]
+            _histogram(lines, "openchange_mapistore_backend_latency_seconds",
+                       [("backend", backend), ("op", _op_name(opnum))], usec, buckets)
+
+    if stats.rops:
+        _header(lines, "openchange_emsmdb_rop_errors_total", "counter", "Failed ROPs")
+        for opnum in sorted(stats.rops):
+            lines.append("openchange_emsmdb_rop_errors_total%s %d"
+                         % (_labels([("rop", "0x%.2x" % opnum)]), stats.rops[opnum][1]))
+        _header(lines, "openchange_emsmdb_rop_latency_seconds", "histogram", "Latency of the ROPs")
+        for opnum in sorted(stats.rops):
+            count, errors, usec, buckets = stats.rops[opnum]
+            _histogram(lines, "openchange_emsmdb_rop_latency_seconds",
+                       [("rop", "0x%.2x" % opnum)], usec, buckets)
+
+        _header(lines, "openchange_emsmdb_session_memory_bytes", "gauge", "Memory of the EMSMDB sessions")
+        lines.append("openchange_emsmdb_session_memory_bytes %d" % stats.session_memory)
+
+    if stats.objects:
+        _header(lines, "openchange_emsmdb_objects", "gauge", "Live emsmdbp objects")
+        for objtype in sorted(stats.objects):
+            lines.append("openchange_emsmdb_objects%s %d"
+                         % (_labels([("type", _object_name(objtype))]), stats.objects[objtype][0]))
+        _header(lines, "openchange_emsmdb_objects_created_total", "counter", "Created emsmdbp objects")
+        for objtype in sorted(stats.objects):
+            lines.append("openchange_emsmdb_objects_created_total%s %d"
+                         % (_labels([("type", _object_name(objtype))]), stats.objects[objtype][1]))
+
+    return "\n".join(lines) + "\n"
+
+
+def _op_name(opnum):
+    if opnum < len(BACKEND_OPS):
+        return BACKEND_OPS[opnum]
+    return "op%d" % opnum
+
+
+def _object_name(objtype):
+    if objtype < len(OBJECT_NAMES):
+        return OBJECT_NAMES[objtype]
+    return "0x%x" % objtype
@@ -19,6 +19,8 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+
 #include <dovecot/config.h>
 #include <dovecot/lib.h>
 #include <dovecot/compat.h>
@@ -81,6 +83,19 @@ enum openchange_event {
 
 #define	OPENCHANGE_DEFAULT_EVENTS	(OPENCHANGE_EVENT_SAVE)
 
+/* Send timeout (ms) while the connection to a server instance is not
+ * established yet */
+#define	OPENCHANGE_CONNECT_TIMEOUT	200
+
+/* A socket connected to one OpenChange server instance */
+struct openchange_publisher {
+	struct openchange_publisher	*prev;
+	struct openchange_publisher	*next;
+	char				*host;
+	int				sock;
+	int				endpoint;
+};
+
 struct openchange_user {
 	union mail_user_module_context	module_ctx;
 	enum openchange_field		fields;
@@ -88,6 +103,12 @@ struct openchange_user {
 	const char			*resolver;
 	const char			*username;
 	const char			*backend;
+
+	/* kept for the lifetime of the user */
+	TALLOC_CTX			*mem_ctx;
+	struct loadparm_context		*lp_ctx;
+	struct mapistore_context	*mstore_ctx;
+	struct openchange_publisher	*publishers;
 };
 
 struct openchange_message {
@@ -95,6 +116,7 @@ struct openchange_message {
 	struct openchange_message	*next;
 	enum openchange_event		event;
 	uint32_t			uid;
+	bool				notified;
 	char				sep;
 	const char			*destination_folder;
 };
@@ -118,13 +140,30 @@ __END_DECLS
 
 static MODULE_CONTEXT_DEFINE_INIT(openchange_user_module, &mail_user_module_register);
 
+static void openchange_mail_user_deinit(struct mail_user *user)
+{
+	struct openchange_user		*ocuser = OPENCHANGE_USER_CONTEXT(user);
+	struct openchange_publisher	*publisher;
+
+	for (publisher = ocuser->publishers; publisher; publisher = publisher->next) {
+		nn_close(publisher->sock);
+	}
+	talloc_free(ocuser->mem_ctx);
+
+	ocuser->module_ctx.super.deinit(user);
+}
+
 static void openchange_mail_user_created(struct mail_user *user)
 {
+	struct mail_user_vfuncs	*v = user->vlast;
 	struct openchange_user	*ocuser;
 	const char		*str;
 	char			*aux;
 
 	ocuser = p_new(user->pool, struct openchange_user, 1);
+	ocuser->module_ctx.super = *v;
+	user->vlast = &ocuser->module_ctx.super;
+	v->deinit = openchange_mail_user_deinit;
 	MODULE_CONTEXT_SET(user, openchange_user_module, ocuser);
 
 	ocuser->fields = OPENCHANGE_DEFAULT_FIELDS;
@@ -199,128 +238,241 @@ static void *openchange_mail_transaction_begin(struct mailbox_transaction_contex
 }
 
 
-static bool openchange_newmail(struct openchange_user *user,
-			       const struct openchange_message *msg)
+/**
+   \details Initialize the mapistore notification context of a user
+   on first use, it is kept for the lifetime of the user
+
+   \return true on success, otherwise false
+ */
+static bool openchange_notification_init(struct openchange_user *user)
 {
-	TALLOC_CTX				*mem_ctx;
 	enum mapistore_error			retval;
-	struct loadparm_context			*lp_ctx;
-	struct mapistore_context		mstore_ctx;
 	struct mapistore_notification_context	*ctx;
 	bool					bret;
-	int					ret = false;
-	int					rc;
-	int					sock;
-	int					endpoint;
-	int					timeout;
-	int					i;
-	int					bytes;
-	uint32_t				count = 0;
-	const char				**hosts = NULL;
-	char					*data = NULL;
-	uint8_t					*blob = NULL;
-	size_t					msglen;
 
-	mem_ctx = talloc_new(NULL);
-	if (!mem_ctx) {
-		i_debug("unable to initialize memory context");
-		return false;
+	if (user->mstore_ctx) return true;
+
+	if (!user->mem_ctx) {
+		user->mem_ctx = talloc_named(NULL, 0, "openchange_user");
+		if (!user->mem_ctx) {
+			i_debug("unable to initialize memory context");
+			return false;
+		}
 	}
 
-	lp_ctx = loadparm_init_global(true);
-	if (!lp_ctx) {
-		i_debug("unable to load global parameters");
-		talloc_free(mem_ctx);
+	if (!user->lp_ctx) {
+		user->lp_ctx = loadparm_init_global(true);
+		if (!user->lp_ctx) {
+			i_debug("unable to load global parameters");
+			return false;
+		}
+		(void) talloc_reference(user->mem_ctx, user->lp_ctx);
+
+		if (user->resolver) {
+			bret = lpcfg_set_cmdline(user->lp_ctx, "mapistore:notification_cache", user->resolver);
+			if (bret == false) {
+				i_fatal("unable to set resolver address '%s'", user->resolver);
+			}
+		}
+	}
+
+	retval = mapistore_notification_init(user->mem_ctx, user->lp_ctx, &ctx);
+	if (retval != MAPISTORE_SUCCESS) {
+		i_debug("unable to initialize mapistore notification");
 		return false;
 	}
 
-	data = talloc_asprintf(mem_ctx, "%d.eml", msg->uid);
-	if (!data) {
+	user->mstore_ctx = talloc_zero(user->mem_ctx, struct mapistore_context);
+	if (!user->mstore_ctx) {
 		i_debug("unable to allocate memory");
-		goto end;
+		talloc_free(ctx);
+		return false;
 	}
+	user->mstore_ctx->notification_ctx = ctx;
 
-	retval = mapistore_notification_payload_newmail(mem_ctx, (char *) user->backend, data, (char *) msg->destination_folder,
-							msg->sep, &blob, &msglen);
-	talloc_free(data);
-	if (retval) {
-		i_debug("unable to generate newmail payload for user %s with msg uid=%d",
-			user->username, msg->uid);
-		goto end;
-	}
+	return true;
+}
 
-	/* initialize mapistore notification */
-	if (user->resolver) {
-		bret = lpcfg_set_cmdline(lp_ctx, "mapistore:notification_cache", user->resolver);
-		if (bret == false) {
-			i_fatal("unable to set resolver address '%s'", user->resolver);
+/**
+   \details Return the socket connected to a server instance, the
+   connection is established on first use and kept for the lifetime of
+   the user
+
+   \return the socket on success, otherwise -1
+ */
+static int openchange_publisher_get(struct openchange_user *user, const char *host,
+				    bool *connectingp)
+{
+	struct openchange_publisher	*publisher;
+
+	*connectingp = false;
+	for (publisher = user->publishers; publisher; publisher = publisher->next) {
+		if (!strcmp(publisher->host, host)) {
+			return publisher->sock;
 		}
 	}
-	retval = mapistore_notification_init(mem_ctx, lp_ctx, &ctx);
-	if (retval != MAPISTORE_SUCCESS) {
-		i_debug("unable to initialize mapistore notification");
-		goto end;
+
+	publisher = talloc_zero(user->mem_ctx, struct openchange_publisher);
+	if (!publisher) {
+		i_debug("unable to allocate memory");
+		return -1;
 	}
-	mstore_ctx.notification_ctx = ctx;
+	publisher->host = talloc_strdup(publisher, host);
 
-	/* Check if the user is registered */
-	retval = mapistore_notification_resolver_exist(&mstore_ctx, user->username);
-	if (retval) {
-		i_debug("resolver: %s", mapistore_errstr(retval));
-		goto end;
+	/* Create socket with super powers */
+	publisher->sock = nn_socket(AF_SP, NN_PUSH);
+	if (!publisher->host || publisher->sock < 0) {
+		i_debug("unable to create socket");
+		talloc_free(publisher);
+		return -1;
 	}
 
-	/* Retrieve server instances */
-	retval = mapistore_notification_resolver_get(mem_ctx, &mstore_ctx, user->username,
-						     &count, &hosts);
-	if (retval) {
-		i_debug("resolver record: %s", mapistore_errstr(retval));
-		goto end;
+	publisher->endpoint = nn_connect(publisher->sock, host);
+	if (publisher->endpoint < 0) {
+		i_debug("unable to connect to %s", host);
+		nn_close(publisher->sock);
+		talloc_free(publisher);
+		return -1;
 	}
 
-	/* Create socket with super powers */
-	sock = nn_socket(AF_SP, NN_PUSH);
+	DLLIST_PREPEND(&user->publishers, publisher);
+	*connectingp = true;
+
+	return publisher->sock;
+}
+
+/**
+   \details Publish a notification payload to a server instance
+
+   The payload is queued on the socket without waiting. Only while the
+   connection to a new server instance is being established, the send
+   waits up to OPENCHANGE_CONNECT_TIMEOUT.
+
+   \return true on success, otherwise false
+ */
+static bool openchange_publish(struct openchange_user *user, const char *host,
+			       const uint8_t *blob, size_t length)
+{
+	bool	connecting;
+	int	sock;
+	int	bytes;
+	int	timeout;
+
+	sock = openchange_publisher_get(user, host, &connecting);
 	if (sock < 0) {
-		i_debug("unable to create socket");
 		return false;
 	}
 
-	timeout = 200;
-	rc = nn_setsockopt(sock, NN_SOL_SOCKET, NN_SNDTIMEO, &timeout, sizeof(timeout));
-	if (rc < 0) {
-		i_debug("unable to set timeout on socket send");
-		goto end;
+	bytes = nn_send(sock, blob, length, NN_DONTWAIT);
+	if (bytes < 0 && nn_errno() == EAGAIN && connecting) {
+		timeout = OPENCHANGE_CONNECT_TIMEOUT;
+		if (nn_setsockopt(sock, NN_SOL_SOCKET, NN_SNDTIMEO, &timeout, sizeof(timeout)) < 0) {
+			i_debug("unable to set timeout on socket send");
+		}
+		bytes = nn_send(sock, blob, length, 0);
 	}
+	if (bytes < 0 || (size_t) bytes != length) {
+		i_debug("Error sending msg to %s: %d sent but %zu expected", host, bytes, length);
+		return false;
+	}
+
+	return true;
+}
 
-	for (i = 0; i < count; i++) {
-		endpoint = nn_connect(sock, hosts[i]);
-		if (endpoint < 0) {
-			oc_log(OC_LOG_ERROR, "unable to connect to %s", hosts[i]);
+/**
+   \details Notify the server instances of a user about the messages of
+   a transaction saved in the destination folder of the first one
+
+   The newmail payloads of all these messages are concatenated and
+   published at once.
+
+   \param user the recipient
+   \param first the first message not notified yet
+   \param count the number of server instances
+   \param hosts the server instances
+
+   \return true on success, otherwise false
+ */
+static bool openchange_newmail(struct openchange_user *user,
+			       struct openchange_message *first,
+			       uint32_t count, const char **hosts)
+{
+	TALLOC_CTX			*mem_ctx;
+	enum mapistore_error		retval;
+	struct openchange_message	*msg;
+	char				*data = NULL;
+	uint8_t				*blob = NULL;
+	uint8_t				*payload = NULL;
+	size_t				msglen;
+	size_t				length = 0;
+	uint32_t			messages = 0;
+	uint32_t			i;
+	bool				ret = true;
+
+	mem_ctx = talloc_new(user->mem_ctx);
+	if (!mem_ctx) {
+		i_debug("unable to initialize memory context");
+		return false;
+	}
+
+	for (msg = first; msg != NULL; msg = msg->next) {
+		if (msg->notified || !msg->uid || msg->sep != first->sep
+		    || strcmp(msg->destination_folder, first->destination_folder)) {
 			continue;
 		}
-		bytes = nn_send(sock, (char *)blob, msglen, 0);
-		if (bytes != msglen) {
-			i_debug("Error sending msg: %d sent but %zu expected", bytes, msglen);
+		msg->notified = true;
+
+		data = talloc_asprintf(mem_ctx, "%d.eml", msg->uid);
+		if (!data) {
+			i_debug("unable to allocate memory");
+			continue;
+		}
+		retval = mapistore_notification_payload_newmail(mem_ctx, (char *) user->username, (char *) user->backend,
+								data, (char *) msg->destination_folder, msg->sep, &blob, &msglen);
+		talloc_free(data);
+		if (retval) {
+			i_debug("unable to generate newmail payload for user %s with msg uid=%d",
+				user->username, msg->uid);
+			continue;
+		}
+
+		payload = talloc_realloc(mem_ctx, payload, uint8_t, length + msglen);
+		if (!payload) {
+			i_debug("unable to allocate memory");
+			talloc_free(mem_ctx);
+			return false;
+		}
+		memcpy(payload + length, blob, msglen);
+		length += msglen;
+		messages++;
+		talloc_free(blob);
+	}
+
+	if (messages) {
+		i_debug("%u newmail notification(s) for user %s in %s", messages,
+			user->username, first->destination_folder);
+		for (i = 0; i < count; i++) {
+			ret &= openchange_publish(user, hosts[i], payload, length);
 		}
-		nn_shutdown(sock, endpoint);
 	}
 
-	ret = true;
-end:
-	talloc_free(lp_ctx);
 	talloc_free(mem_ctx);
 	return ret;
 }
 
 static void openchange_mail_transaction_commit(void *txn, struct mail_transaction_commit_changes *changes)
 {
+	TALLOC_CTX				*mem_ctx = NULL;
 	struct openchange_mail_txn_context	*ctx;
 	struct openchange_message		*msg;
 	struct openchange_user			*user;
 	struct seq_range_iter			iter;
+	enum mapistore_error			retval;
 	uint32_t				uid;
-	int					rc;
+	uint32_t				count = 0;
+	const char				**hosts = NULL;
 	unsigned int				n = 0;
+	unsigned int				saved = 0;
 
 	ctx = (struct openchange_mail_txn_context *)txn;
 	user = OPENCHANGE_USER_CONTEXT(ctx->ns->user);
@@ -331,12 +483,35 @@ static void openchange_mail_transaction_commit(void *txn, struct mail_transactio
 		    msg->event == OPENCHANGE_EVENT_SAVE) {
 			if (seq_range_array_iter_nth(&iter, n++, &uid)) {
 				msg->uid = uid;
-				openchange_newmail(user, msg);
+				saved++;
 			}
 		}
 	}
 
 	i_assert(!seq_range_array_iter_nth(&iter, n, &uid));
+	if (!saved || !openchange_notification_init(user)) {
+		goto end;
+	}
+
+	/* Retrieve server instances once per transaction, fails if the
+	 * user is not registered */
+	mem_ctx = talloc_new(user->mem_ctx);
+	retval = mapistore_notification_resolver_get(mem_ctx, user->mstore_ctx, user->username,
+						     &count, &hosts);
+	if (retval) {
+		i_debug("resolver record: %s", mapistore_errstr(retval));
+		goto end;
+	}
+
+	/* One notification payload per destination folder */
+	for (msg = ctx->messages; msg != NULL; msg = msg->next) {
+		if (msg->uid && !msg->notified) {
+			openchange_newmail(user, msg, count, hosts);
+		}
+	}
+
+end:
+	talloc_free(mem_ctx);
 	pool_unref(&ctx->pool);
 }
 
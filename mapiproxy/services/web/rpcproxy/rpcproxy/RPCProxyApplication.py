@@ -29,7 +29,7 @@ from channels import RPCProxyInboundChannelHandler,\
 
 
 class RPCProxyApplication(object):
-    def __init__(self, samba_host, log_level=logging.DEBUG):
+    def __init__(self, samba_host, log_level=logging.DEBUG, shard_ring=None):
         # we keep a reference to the rmtree function until our instance is
         # deleted
         self.rmtree = rmtree
@@ -60,6 +60,7 @@ class RPCProxyApplication(object):
 
         self.samba_host = samba_host
         self.log_level = log_level
+        self.shard_ring = shard_ring
 
     def __del__(self):
         # self.rmtree(self.sockets_dir)
@@ -114,4 +115,5 @@ class RPCProxyApplication(object):
     def _do_RPC_OUT_DATA(self, logger):
         return RPCProxyOutboundChannelHandler(self.sockets_dir,
                                               self.samba_host,
-                                              logger)
+                                              logger,
+                                              self.shard_ring)
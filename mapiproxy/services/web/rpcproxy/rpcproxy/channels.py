@@ -42,6 +42,8 @@ from openchange.utils.packets import (RTS_CMD_CONNECTION_TIMEOUT,
                                       RTS_CMD_DATA_LABELS,
                                       RPCPacket, RPCRTSPacket, RPCRTSOutPacket)
 
+from utils import set_keepalive
+
 
 # Connection Timeout Timer (in ms)
 INBOUND_PROXY_CONN_TIMEOUT = 120000
@@ -340,9 +342,11 @@ class RPCProxyInboundChannelHandler(RPCProxyChannelHandler):
 
 
 class RPCProxyOutboundChannelHandler(RPCProxyChannelHandler):
-    def __init__(self, sockets_dir, samba_host, logger):
+    def __init__(self, sockets_dir, samba_host, logger, shard_ring=None):
         RPCProxyChannelHandler.__init__(self, sockets_dir, logger)
         self.samba_host = samba_host
+        self.shard_ring = shard_ring
+        self.oc_host = samba_host
         self.oc_conn = None
         self.in_window_size = 0
         self.in_conn_timeout = 0
@@ -391,14 +395,26 @@ class RPCProxyOutboundChannelHandler(RPCProxyChannelHandler):
 
         return packet.make()
 
+    def _select_oc_host(self, environ):
+        # The client asks for the RPC server autodiscover gave it, which
+        # is the node serving its mailbox when mailboxes are sharded.
+        # Only the nodes of the ring are accepted, so this is not an
+        # open relay.
+        if self.shard_ring is None:
+            return
+        server = environ.get("QUERY_STRING", "").split(":")[0].lower()
+        if server in self.shard_ring and server != self.shard_ring.local:
+            self.oc_host = server
+
     def _setup_oc_socket(self):
         # create IP connection to OpenChange
-        self.logger.debug("connecting to %s:1024" % self.samba_host)
+        self.logger.debug("connecting to %s:1024" % self.oc_host)
         connected = False
         while not connected:
             try:
                 oc_conn = socket(AF_INET, SOCK_STREAM)
-                oc_conn.connect((self.samba_host, 1024))
+                oc_conn.connect((self.oc_host, 1024))
+                set_keepalive(oc_conn)
                 connected = True
             except socket_error:
                 self.logger.debug("failure to connect, retrying...")
@@ -579,6 +595,7 @@ class RPCProxyOutboundChannelHandler(RPCProxyChannelHandler):
                             ("Content-length", "%d" % (1024 ** 3))])
 
             yield self._send_conn_a3()
+            self._select_oc_host(environ)
             self._setup_oc_socket()
             self._setup_channel_socket()
             connected = self._wait_IN_channel()
@@ -0,0 +1,874 @@
+# relay.py -- OpenChange RPC-over-HTTP implementation
+# -*- coding: utf-8 -*-
+#
+# Copyright (C) 2015  OpenChange Project
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Event-driven relay mode for rpcproxy.
+
+The WSGI application relays each channel with blocking sockets in the
+thread serving the HTTP request, which keeps two Apache workers busy
+for as long as Outlook stays connected. The relay is a standalone
+process serving the RPC_IN_DATA and RPC_OUT_DATA requests itself: one
+epoll loop (poll where epoll is not available) carries every channel
+pair, so an idle client costs three file descriptors and a few buffers
+instead of two threads.
+
+Behaviour on the wire is the one of channels.py:
+
+ * echo requests are answered with an echo RTS PDU;
+ * the OUT channel receives CONN/A3, then CONN/C2 once the IN channel
+   with the same connection cookie has arrived, then everything the
+   server sends;
+ * the IN channel PDUs are forwarded to the server, RTS PDUs are
+   dropped and FlowControlAck PDUs are sent on the OUT channel;
+ * the OUT channel is pinged when it stayed idle for most of the
+   connection timeout.
+
+The pairing of channels happens in memory, no unix socket is used.
+Backend connections have TCP keepalive enabled, and a pool of spare
+connections to the local server can be kept open so that new clients do
+not wait for the TCP handshake. A backend connection is never given to
+two clients, as it carries the client binding.
+
+Clients are authenticated with NTLM through the NTLMAuthHandler daemon,
+using the same cookie as the WSGI middleware. Talking to the daemon is
+a short local unix socket transaction and is done synchronously.
+
+The relay speaks plain HTTP: put a TLS terminator working at the TCP
+level (stunnel, haproxy in tcp mode) in front of it, as the requests
+declare bodies of up to 1 GiB which HTTP reverse proxies buffer.
+
+"""
+
+import errno
+import logging
+from optparse import OptionParser
+import os
+import select
+import socket
+from cStringIO import StringIO
+from struct import unpack_from
+from time import time
+from uuid import UUID, uuid4
+
+from openchange.utils.packets import (DCERPC_PKT_RTS,
+                                      RTS_CMD_CONNECTION_TIMEOUT,
+                                      RTS_CMD_DESTINATION,
+                                      RTS_CMD_FLOW_CONTROL_ACK,
+                                      RTS_CMD_RECEIVE_WINDOW_SIZE,
+                                      RTS_CMD_VERSION,
+                                      RTS_FLAG_ECHO,
+                                      RTS_FLAG_PING,
+                                      RPCPacket, RPCRTSPacket, RPCRTSOutPacket)
+from openchange.web.auth.NTLMAuthHandler import _NTLMAuthClient
+
+from channels import INBOUND_PROXY_CONN_TIMEOUT, OUTBOUND_PROXY_CONN_TIMEOUT
+from utils import set_keepalive
+
+
+# Receive window advertised for the IN channel (256KiB, max size allowed)
+IN_WINDOW_SIZE = 256 * 1024
+
+# Time left to the IN channel to show up after the OUT channel (in s)
+PAIRING_TIMEOUT = 10
+
+# Delay before retrying to connect to OpenChange (in s)
+BACKEND_RETRY_DELAY = 1
+
+# A peer is not read anymore while that much is waiting to be sent
+MAX_BUFFERED = 1024 * 1024
+
+# Longest accepted request header
+MAX_HEADER_SIZE = 16 * 1024
+
+RECV_SIZE = 64 * 1024
+
+EV_READ = select.POLLIN
+EV_WRITE = select.POLLOUT
+EV_CLOSE = select.POLLHUP | select.POLLERR
+
+_FATAL_ERRNOS = (errno.ECONNRESET, errno.EPIPE, errno.ETIMEDOUT,
+                 errno.ECONNREFUSED, errno.EHOSTUNREACH, errno.ENETUNREACH)
+
+
+class _Poller(object):
+    """epoll with a poll fallback, both exposing the poll interface."""
+
+    def __init__(self):
+        if hasattr(select, "epoll"):
+            self.impl = select.epoll()
+            self.timeout_scale = 1.0
+            self.events = {EV_READ: select.EPOLLIN,
+                           EV_WRITE: select.EPOLLOUT}
+        else:
+            self.impl = select.poll()
+            self.timeout_scale = 1000.0
+            self.events = {EV_READ: select.POLLIN,
+                           EV_WRITE: select.POLLOUT}
+
+    def _mask(self, events):
+        mask = 0
+        for (event, value) in self.events.iteritems():
+            if events & event:
+                mask = mask | value
+        return mask
+
+    def register(self, fd, events):
+        self.impl.register(fd, self._mask(events))
+
+    def modify(self, fd, events):
+        self.impl.modify(fd, self._mask(events))
+
+    def unregister(self, fd):
+        self.impl.unregister(fd)
+
+    def poll(self, timeout):
+        # the EPOLL* and POLL* values match on Linux
+        return self.impl.poll(timeout * self.timeout_scale)
+
+
+class _Endpoint(object):
+    """A non-blocking socket with its pending output."""
+
+    def __init__(self, relay, sock):
+        self.relay = relay
+        self.sock = sock
+        self.fd = sock.fileno()
+        self.outbuf = ""
+        self.vconn = None
+        self.events = 0
+        self.closing = False
+        self.closed = False
+
+        sock.setblocking(0)
+
+    def write(self, data):
+        self.outbuf = self.outbuf + data
+
+    def flush(self):
+        while self.outbuf:
+            sent = self.sock.send(self.outbuf[:RECV_SIZE])
+            self.outbuf = self.outbuf[sent:]
+
+    def wants_read(self):
+        return not self.closing
+
+    def on_read(self, data):
+        raise NotImplementedError
+
+    def on_writable(self):
+        pass
+
+    def on_close(self):
+        pass
+
+
+class _Backend(_Endpoint):
+    """A connection to the OpenChange server."""
+
+    def __init__(self, relay, host, logger):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        _Endpoint.__init__(self, relay, sock)
+        self.host = host
+        self.logger = logger
+        self.connected = False
+
+        set_keepalive(sock)
+        code = sock.connect_ex((host, 1024))
+        if code == 0:
+            self.connected = True
+        elif code not in (errno.EINPROGRESS, errno.EWOULDBLOCK):
+            raise socket.error(code, os.strerror(code))
+
+    def wants_read(self):
+        if not self.connected or self.closing:
+            return False
+        # backpressure on a slow client
+        if self.vconn is not None and self.vconn.out_channel is not None:
+            return len(self.vconn.out_channel.outbuf) < MAX_BUFFERED
+        return True
+
+    def on_writable(self):
+        if not self.connected:
+            code = self.sock.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR)
+            if code != 0:
+                raise socket.error(code, os.strerror(code))
+            self.connected = True
+            self.logger.debug("connection to OC succeeded (fileno=%d)"
+                              % self.fd)
+
+    def on_read(self, data):
+        if self.vconn is None:
+            # spare connections are not expected to receive anything
+            self.logger.debug("unexpected data on spare OC connection")
+            self.relay.close(self)
+        else:
+            self.vconn.server_data(data)
+
+    def on_close(self):
+        if self.vconn is not None:
+            self.logger.debug("connection closed from OC")
+            self.vconn.shutdown()
+        else:
+            self.relay.spare_closed(self)
+
+
+class _VirtualConnection(object):
+    """An IN and OUT channel pair, and its backend connection."""
+
+    def __init__(self, relay, connection_cookie, logger):
+        self.relay = relay
+        self.connection_cookie = connection_cookie
+        self.logger = logger
+        self.created = time()
+
+        self.out_channel = None
+        self.in_channel = None
+        self.backend = None
+
+        self.in_window_size = IN_WINDOW_SIZE
+        self.in_conn_timeout = INBOUND_PROXY_CONN_TIMEOUT
+        # flow control of the IN channel
+        self.local_available_window = IN_WINDOW_SIZE
+        self.rpc_pdu_bytes_received = 0
+        self.in_channel_cookie = None
+
+        self.bytes_to_client = 0
+        self.bytes_to_server = 0
+        self.last_out_write = time()
+        self.terminated = False
+
+    def attach_out(self, channel, backend):
+        self.out_channel = channel
+        self.backend = backend
+        backend.vconn = self
+        if self.in_channel is not None:
+            self._paired()
+
+    def attach_in(self, channel):
+        self.in_channel = channel
+        self.in_channel_cookie = channel.channel_cookie
+        if self.out_channel is not None:
+            self._paired()
+
+    def _paired(self):
+        self.logger.debug("connection established with IN channel")
+        packet = RPCRTSOutPacket(self.logger)
+        packet.add_command(RTS_CMD_VERSION, 1)
+        packet.add_command(RTS_CMD_RECEIVE_WINDOW_SIZE, self.in_window_size)
+        packet.add_command(RTS_CMD_CONNECTION_TIMEOUT, self.in_conn_timeout)
+        self.send_to_client(packet.make())
+        # the IN channel may have sent PDUs along with CONN/B1
+        self.in_channel.process_pdus()
+
+    def paired(self):
+        return self.in_channel is not None and self.out_channel is not None
+
+    def send_to_client(self, data):
+        self.out_channel.write(data)
+        self.bytes_to_client = self.bytes_to_client + len(data)
+        self.last_out_write = time()
+
+    def server_data(self, data):
+        self.send_to_client(data)
+
+    def client_pdu(self, pdu):
+        if ord(pdu[2]) == DCERPC_PKT_RTS:
+            self.logger.debug("ignored RTS packet from IN channel")
+            return
+
+        self.backend.write(pdu)
+        self.bytes_to_server = self.bytes_to_server + len(pdu)
+
+        # Flow control (only subject to RPC PDUs)
+        self.local_available_window -= len(pdu)
+        self.rpc_pdu_bytes_received += len(pdu)
+        if self.local_available_window < self.in_window_size / 2:
+            self.logger.debug("sending FlowControlAck after %d of available"
+                              " window size" % self.local_available_window)
+            packet = RPCRTSOutPacket(self.logger)
+            packet.add_command(RTS_CMD_DESTINATION, 0)
+            packet.add_command(RTS_CMD_FLOW_CONTROL_ACK,
+                               {'bytes_received': self.rpc_pdu_bytes_received,
+                                'available_window': self.in_window_size,
+                                'channel_cookie': self.in_channel_cookie})
+            self.send_to_client(packet.make())
+            self.local_available_window = self.in_window_size
+
+    def check_timers(self, now):
+        if not self.paired():
+            if self.created + PAIRING_TIMEOUT < now:
+                self.logger.info("IN channel failed to connect in the last"
+                                 " %d seconds" % PAIRING_TIMEOUT)
+                self.shutdown()
+        elif (self.last_out_write + 0.9 * OUTBOUND_PROXY_CONN_TIMEOUT / 1000.0
+              < now):
+            # [MS-RPCH] Section 3.2.4.6: keep the connection alive
+            self.logger.debug("sending PING RTS PDU to client")
+            packet = RPCRTSOutPacket(self.logger)
+            packet.flags = RTS_FLAG_PING
+            self.send_to_client(packet.make())
+
+    def shutdown(self):
+        if self.terminated:
+            return
+        self.terminated = True
+        self.logger.debug("channel kept alive during %f secs;"
+                          " %d bytes sent to client; %d bytes sent to server"
+                          % ((time() - self.created),
+                             self.bytes_to_client, self.bytes_to_server))
+        self.relay.forget(self)
+        # what was already received is still delivered
+        for endpoint in (self.out_channel, self.in_channel, self.backend):
+            if endpoint is not None:
+                self.relay.close(endpoint, flush=True)
+
+
+class _ClientConnection(_Endpoint):
+    """An HTTP connection from a client, which may become a channel."""
+
+    def __init__(self, relay, sock, address):
+        _Endpoint.__init__(self, relay, sock)
+        self.address = address
+        self.logger = relay.make_logger("%s:%d" % address)
+        self.inbuf = ""
+        self.discard = 0
+        self.request = None
+        self.channel_cookie = None
+
+    def wants_read(self):
+        if self.closing:
+            return False
+        # backpressure on a slow server
+        if (self.vconn is not None and self.request["method"] == "RPC_IN_DATA"
+            and self.vconn.backend is not None):
+            return len(self.vconn.backend.outbuf) < MAX_BUFFERED
+        return True
+
+    def on_read(self, data):
+        self.inbuf = self.inbuf + data
+        while not self.closing:
+            if self.discard > 0:
+                skipped = min(self.discard, len(self.inbuf))
+                self.inbuf = self.inbuf[skipped:]
+                self.discard = self.discard - skipped
+                if self.discard > 0:
+                    break
+            if self.request is None:
+                if not self._parse_request():
+                    break
+                self._dispatch()
+            elif self.vconn is not None:
+                self.process_pdus()
+                break
+            else:
+                self._start_channel()
+                break
+
+    def on_close(self):
+        if self.vconn is not None:
+            self.logger.debug("client connection closed")
+            self.vconn.shutdown()
+
+    def _parse_request(self):
+        end = self.inbuf.find("\r\n\r\n")
+        if end < 0:
+            if len(self.inbuf) > MAX_HEADER_SIZE:
+                self._respond("400 Bad Request", close=True)
+            return False
+
+        lines = self.inbuf[:end].split("\r\n")
+        self.inbuf = self.inbuf[end + 4:]
+
+        parts = lines[0].split(" ")
+        if len(parts) != 3:
+            self._respond("400 Bad Request", close=True)
+            return False
+        (method, uri, version) = parts
+        headers = {}
+        for line in lines[1:]:
+            if ":" in line:
+                (name, value) = line.split(":", 1)
+                headers[name.strip().lower()] = value.strip()
+        try:
+            content_length = int(headers.get("content-length", "0"))
+        except ValueError:
+            self._respond("400 Bad Request", close=True)
+            return False
+
+        if "?" in uri:
+            query_string = uri.split("?", 1)[1]
+        else:
+            query_string = ""
+        self.request = {"method": method,
+                        "query_string": query_string,
+                        "headers": headers,
+                        "content_length": content_length}
+        self.logger.debug("processing %s request, size is %d"
+                          % (method, content_length))
+        return True
+
+    def _respond(self, status, headers=None, body="", close=False):
+        lines = ["HTTP/1.1 %s" % status]
+        if headers is None:
+            headers = [("Content-Type", "text/plain"),
+                       ("Content-Length", "%d" % len(body))]
+        lines.extend(["%s: %s" % header for header in headers])
+        if close:
+            lines.append("Connection: close")
+        self.write("\r\n".join(lines) + "\r\n\r\n" + body)
+        if close:
+            self.relay.close(self, flush=True)
+
+    def _next_request(self):
+        # the body of a request which is not a channel is skipped
+        self.discard = self.request["content_length"]
+        self.request = None
+
+    def _dispatch(self):
+        request = self.request
+        if request["method"] not in ("RPC_IN_DATA", "RPC_OUT_DATA"):
+            msg = "Unsupported method"
+            self._respond("501 Not Implemented", body=msg, close=True)
+            return
+
+        if not self._authenticate():
+            return
+
+        content_length = request["content_length"]
+        if content_length <= 0x10:
+            self.logger.debug("handling echo request")
+            packet = RPCRTSOutPacket()
+            packet.flags = RTS_FLAG_ECHO
+            data = packet.make()
+            self._respond("200 Success",
+                          [("Content-Length", "%d" % len(data)),
+                           ("Content-Type", "application/rpc")], data)
+            self._next_request()
+        elif ((request["method"] == "RPC_OUT_DATA" and content_length != 76)
+              or (request["method"] == "RPC_IN_DATA" and content_length < 128)):
+            self.logger.error("content-length %d is not handled"
+                              % content_length)
+            self._respond("500 Internal Error", close=True)
+
+    def _authenticate(self):
+        """Run the NTLMAuthHandler logic for the current request."""
+
+        headers = self.request["headers"]
+        cookie_name = self.relay.cookie_name
+        client_id = None
+        cookies = {}
+        for pair in headers.get("cookie", "").split(";"):
+            if "=" in pair:
+                (key, value) = pair.strip().split("=", 1)
+                cookies[key] = value
+
+        connection = _NTLMAuthClient(self.relay.work_dir, self.relay.samba_host)
+        try:
+            if cookie_name in cookies:
+                client_id = cookies[cookie_name]
+                server_knows_client = connection.server_knows_client(client_id)
+            else:
+                server_knows_client = False
+
+            auth = headers.get("authorization")
+            if auth is not None and auth[:5].upper() == "NTLM ":
+                ntlm_payload = auth[5:].decode("base64")
+                if server_knows_client:
+                    (success, payload) \
+                        = connection.ntlm_transaction(client_id, ntlm_payload)
+                    if success:
+                        return True
+                    self._challenge()
+                else:
+                    client_id = str(uuid4())
+                    (success, payload) \
+                        = connection.ntlm_transaction(client_id, ntlm_payload)
+                    if success:
+                        self._challenge(payload, client_id)
+                    else:
+                        self._challenge()
+            elif server_knows_client:
+                return True
+            else:
+                self._challenge()
+        finally:
+            connection.close()
+
+        return False
+
+    def _challenge(self, ntlm_data=None, client_id=None):
+        content = "More data needed...\r\n"
+        headers = [("Content-Type", "text/plain"),
+                   ("Content-Length", "%d" % len(content))]
+        if ntlm_data is None:
+            www_auth_value = "NTLM"
+        else:
+            www_auth_value = ("NTLM %s" % ntlm_data.encode("base64")
+                              .strip().replace("\n", ""))
+        if client_id is not None:
+            headers.append(("Set-Cookie", "%s=%s"
+                            % (self.relay.cookie_name, client_id)))
+        headers.append(("WWW-Authenticate", www_auth_value))
+
+        # the declared bodies of channel requests are far too large to
+        # be skipped, the cookie carries the state to the next connection
+        close = self.request["content_length"] > MAX_HEADER_SIZE
+        self._respond("401 Unauthorized", headers, content, close)
+        if not close:
+            self._next_request()
+
+    def _first_pdu(self):
+        if len(self.inbuf) < 16:
+            return None
+        frag_length = unpack_from("<h", self.inbuf, 8)[0]
+        if len(self.inbuf) < frag_length:
+            return None
+        data = self.inbuf[:frag_length]
+        self.inbuf = self.inbuf[frag_length:]
+        return RPCPacket.from_file(StringIO(data), self.logger)
+
+    def _start_channel(self):
+        packet = self._first_pdu()
+        if packet is None:
+            return
+        if not isinstance(packet, RPCRTSPacket):
+            self.logger.error("unexpected non-rts packet received for %s"
+                              % ("CONN/A1" if self.request["method"]
+                                 == "RPC_OUT_DATA" else "CONN/B1"))
+            self.relay.close(self)
+            return
+        self.logger.debug("packet headers = " + packet.pretty_dump())
+
+        connection_cookie = str(UUID(bytes_le=packet.commands[1]["Cookie"]))
+        self.channel_cookie = str(UUID(bytes_le=packet.commands[2]["Cookie"]))
+        if self.request["method"] == "RPC_OUT_DATA":
+            self._start_out_channel(connection_cookie)
+        else:
+            self._start_in_channel(connection_cookie)
+
+    def _start_out_channel(self, connection_cookie):
+        self.logger.debug("received CONN/A1")
+        backend = self.relay.get_backend(self._select_oc_host(), self.logger)
+        if backend is None:
+            self.relay.close(self)
+            return
+
+        # Content-length = 1 Gib
+        self._respond("200 Success",
+                      [("Content-Type", "application/rpc"),
+                       ("Content-Length", "%d" % (1024 ** 3))])
+        packet = RPCRTSOutPacket(self.logger)
+        packet.add_command(RTS_CMD_CONNECTION_TIMEOUT,
+                           OUTBOUND_PROXY_CONN_TIMEOUT)
+        self.write(packet.make())
+
+        self.vconn = self.relay.lookup(connection_cookie, self.logger)
+        if self.vconn.out_channel is not None:
+            self.logger.error("OUT channel already established")
+            self.vconn = None
+            self.relay.close(backend)
+            self.relay.close(self, flush=True)
+            return
+        self.vconn.attach_out(self, backend)
+
+    def _start_in_channel(self, connection_cookie):
+        self.logger.debug("received CONN/B1")
+        self.vconn = self.relay.lookup(connection_cookie, self.logger)
+        if self.vconn.in_channel is not None:
+            self.logger.error("IN channel already established")
+            self.vconn = None
+            self.relay.close(self)
+            return
+        self.vconn.attach_in(self)
+
+    def _select_oc_host(self):
+        # same rules as RPCProxyOutboundChannelHandler._select_oc_host
+        shard_ring = self.relay.shard_ring
+        if shard_ring is None:
+            return self.relay.samba_host
+        server = self.request["query_string"].split(":")[0].lower()
+        if server in shard_ring and server != shard_ring.local:
+            return server
+        return self.relay.samba_host
+
+    def process_pdus(self):
+        if self.request["method"] != "RPC_IN_DATA":
+            # nothing is expected from the client on the OUT channel
+            self.inbuf = ""
+            return
+        if not self.vconn.paired():
+            return
+        while len(self.inbuf) >= 16:
+            frag_length = unpack_from("<h", self.inbuf, 8)[0]
+            if len(self.inbuf) < frag_length:
+                break
+            self.vconn.client_pdu(self.inbuf[:frag_length])
+            self.inbuf = self.inbuf[frag_length:]
+
+
+class RPCProxyRelay(object):
+    def __init__(self, listen_address, samba_host, work_dir,
+                 cookie_name="oc-ntlm-auth", spare_connections=0,
+                 log_level=logging.INFO, shard_ring=None):
+        self.listen_address = listen_address
+        self.samba_host = samba_host
+        self.work_dir = work_dir
+        self.cookie_name = cookie_name
+        self.spare_connections = spare_connections
+        self.log_level = log_level
+        self.shard_ring = shard_ring
+        self.logger = self.make_logger("relay")
+
+        self.poller = _Poller()
+        self.endpoints = {}
+        self.vconns = {}
+        self.spares = []
+        self.spare_retry = 0
+        self.listener = None
+
+    def make_logger(self, name):
+        logger = logging.getLogger("rpcproxy.relay.%s" % name)
+        logger.setLevel(self.log_level)
+        return logger
+
+    def _add(self, endpoint):
+        self.endpoints[endpoint.fd] = endpoint
+        endpoint.events = EV_READ
+        self.poller.register(endpoint.fd, endpoint.events)
+        self._update(endpoint)
+
+    def _update(self, endpoint):
+        if endpoint.closed:
+            return
+        events = 0
+        if endpoint.wants_read():
+            events = events | EV_READ
+        if endpoint.outbuf or (isinstance(endpoint, _Backend)
+                               and not endpoint.connected):
+            events = events | EV_WRITE
+        if events != endpoint.events:
+            self.poller.modify(endpoint.fd, events)
+            endpoint.events = events
+
+    def close(self, endpoint, flush=False):
+        if endpoint.closed:
+            return
+        if flush and endpoint.outbuf:
+            # closed once its output has been sent
+            endpoint.closing = True
+            return
+        endpoint.closed = True
+        self.poller.unregister(endpoint.fd)
+        del self.endpoints[endpoint.fd]
+        try:
+            endpoint.sock.shutdown(socket.SHUT_RDWR)
+        except socket.error:
+            pass
+        endpoint.sock.close()
+        endpoint.on_close()
+
+    def lookup(self, connection_cookie, logger):
+        if connection_cookie not in self.vconns:
+            self.vconns[connection_cookie] \
+                = _VirtualConnection(self, connection_cookie, logger)
+        return self.vconns[connection_cookie]
+
+    def forget(self, vconn):
+        if self.vconns.get(vconn.connection_cookie) is vconn:
+            del self.vconns[vconn.connection_cookie]
+
+    def get_backend(self, host, logger):
+        if host == self.samba_host:
+            for backend in self.spares:
+                if backend.connected:
+                    self.spares.remove(backend)
+                    backend.logger = logger
+                    return backend
+
+        logger.debug("connecting to %s:1024" % host)
+        try:
+            backend = _Backend(self, host, logger)
+        except socket.error as e:
+            logger.error("failure to connect to %s: %s" % (host, e))
+            return None
+        self._add(backend)
+        return backend
+
+    def spare_closed(self, backend):
+        if backend in self.spares:
+            self.spares.remove(backend)
+            self.spare_retry = time() + BACKEND_RETRY_DELAY
+
+    def _fill_spares(self, now):
+        if now < self.spare_retry:
+            return
+        while len(self.spares) < self.spare_connections:
+            try:
+                backend = _Backend(self, self.samba_host, self.logger)
+            except socket.error:
+                self.logger.debug("failure to connect, retrying...")
+                self.spare_retry = now + BACKEND_RETRY_DELAY
+                break
+            self._add(backend)
+            self.spares.append(backend)
+
+    def _accept(self):
+        while True:
+            try:
+                (sock, address) = self.listener.accept()
+            except socket.error as e:
+                if e.errno not in (errno.EAGAIN, errno.EWOULDBLOCK,
+                                   errno.ECONNABORTED):
+                    self.logger.error("accept failed: %s" % e)
+                return
+            self._add(_ClientConnection(self, sock, address))
+
+    def _handle_event(self, endpoint, event):
+        if event & (EV_READ | EV_CLOSE):
+            data = endpoint.sock.recv(RECV_SIZE)
+            if not data:
+                self.close(endpoint)
+                return
+            endpoint.on_read(data)
+
+        if endpoint.closed:
+            return
+
+        if event & EV_WRITE:
+            endpoint.on_writable()
+            endpoint.flush()
+            if endpoint.closing and not endpoint.outbuf:
+                self.close(endpoint)
+
+    def _process(self, fd, event):
+        endpoint = self.endpoints.get(fd)
+        if endpoint is None:
+            return
+        try:
+            self._handle_event(endpoint, event)
+        except socket.error as e:
+            if e.errno in (errno.EAGAIN, errno.EWOULDBLOCK):
+                pass
+            elif e.errno in _FATAL_ERRNOS:
+                endpoint.logger.debug("connection lost: %s" % e)
+                self.close(endpoint)
+            else:
+                raise
+        except Exception:
+            endpoint.logger.exception("closing connection after error")
+            self.close(endpoint)
+
+        # the event may have queued data on the peers of the endpoint
+        self._update_group(endpoint)
+
+    def _update_group(self, endpoint):
+        self._update(endpoint)
+        vconn = endpoint.vconn
+        if vconn is not None:
+            for peer in (vconn.out_channel, vconn.in_channel, vconn.backend):
+                if peer is not None and peer is not endpoint:
+                    self._update(peer)
+
+    def run(self):
+        (host, port) = self.listen_address
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind((host, port))
+        self.listener.listen(128)
+        self.listener.setblocking(0)
+        listen_fd = self.listener.fileno()
+        self.poller.register(listen_fd, EV_READ)
+        self.logger.info("RPCProxy relay listening on %s:%d" % (host, port))
+
+        last_timers = 0
+        while True:
+            now = time()
+            if last_timers + 1.0 <= now:
+                last_timers = now
+                self._fill_spares(now)
+                for vconn in self.vconns.values():
+                    vconn.check_timers(now)
+                    if vconn.out_channel is not None:
+                        self._update_group(vconn.out_channel)
+
+            for (fd, event) in self.poller.poll(1.0):
+                if fd == listen_fd:
+                    self._accept()
+                else:
+                    self._process(fd, event)
+
+
+def _parse_address(value):
+    (host, port) = value.rsplit(":", 1)
+    return (host, int(port))
+
+
+def _load_shard_ring(logger):
+    # same as rpcproxy.wsgi
+    try:
+        import samba.param
+        from openchange.shard import load_ring
+        lp = samba.param.LoadParm()
+        lp.load_default()
+        return load_ring(lp)
+    except Exception as e:
+        logger.warn("Unable to load the shard ring from smb.conf: %s", e)
+        return None
+
+
+def main(args=None):
+    parser = OptionParser(usage="%prog [options]",
+                          description="Serve RPC-over-HTTP channels from a"
+                          " single event loop, without Apache. Plain HTTP"
+                          " only: put a TCP level TLS terminator in front.")
+    parser.add_option("--listen", default="127.0.0.1:8081",
+                      help="address to listen on [default: %default]")
+    parser.add_option("--samba-host", default="127.0.0.1",
+                      help="OpenChange server [default: %default]")
+    parser.add_option("--work-dir", default="/var/cache/ntlmauthhandler",
+                      help="NTLMAuthHandler working directory"
+                      " [default: %default]")
+    parser.add_option("--cookie-name", default="oc-ntlm-auth",
+                      help="NTLM authentication cookie [default: %default]")
+    parser.add_option("--spare-connections", type="int", default=0,
+                      help="connections to the OpenChange server kept open"
+                      " for new clients [default: %default]")
+    parser.add_option("--log-level", default="INFO",
+                      help="log level [default: %default]")
+    (opts, args) = parser.parse_args(args)
+
+    log_level = logging.getLevelName(opts.log_level.upper())
+    logging.basicConfig(level=log_level,
+                        format="[%(process)d:%(name)s] %(levelname)s:"
+                        " %(message)s")
+    logger = logging.getLogger("rpcproxy.relay")
+
+    if not os.path.exists(opts.work_dir):
+        parser.error("the NTLMAuthHandler working directory does not exist:"
+                     " '%s'" % opts.work_dir)
+
+    relay = RPCProxyRelay(_parse_address(opts.listen), opts.samba_host,
+                          opts.work_dir, opts.cookie_name,
+                          opts.spare_connections, log_level,
+                          _load_shard_ring(logger))
+    try:
+        relay.run()
+    except KeyboardInterrupt:
+        pass
+
+    return 0
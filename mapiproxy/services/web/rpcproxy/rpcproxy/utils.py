@@ -17,6 +17,13 @@
 #
 
 import json
+import socket
+
+# Backend connections are idle while Outlook is: probe them so that
+# firewalls and NAT keep them open and dead peers are detected
+BACKEND_KEEPALIVE_IDLE = 60
+BACKEND_KEEPALIVE_INTERVAL = 15
+BACKEND_KEEPALIVE_COUNT = 4
 
 
 def prettify_dict(adict):
@@ -30,3 +37,15 @@ def prettify_dict(adict):
     lines = json.dumps(adict, default=_unhandled_objects,
                        sort_keys=True, indent=4)
     return "%s\n" % "\n".join([l.rstrip() for l in lines.splitlines()])
+
+
+def set_keepalive(sock):
+    """Enable TCP keepalive probes on a backend connection."""
+
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_KEEPALIVE, 1)
+    # the probe timings are Linux specific
+    for (name, value) in (("TCP_KEEPIDLE", BACKEND_KEEPALIVE_IDLE),
+                          ("TCP_KEEPINTVL", BACKEND_KEEPALIVE_INTERVAL),
+                          ("TCP_KEEPCNT", BACKEND_KEEPALIVE_COUNT)):
+        if hasattr(socket, name):
+            sock.setsockopt(socket.IPPROTO_TCP, getattr(socket, name), value)
@@ -8,7 +8,7 @@ setup(name="rpcproxy",
       author="Julien Kerihuel, Wolfgang Sourdeau",
       author_email="j.kerihuel@openchange.org, wsourdeau@inverse.ca",
       url="http://www.openchange.org/",
-      scripts=["rpcproxy.wsgi"],
+      scripts=["rpcproxy.wsgi", "rpcproxy-relay"],
       packages=["rpcproxy"],
       requires=["openchange"]
 )
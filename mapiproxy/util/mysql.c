@@ -20,8 +20,11 @@
  */
 
 #include "mysql.h"
+#include "trace.h"
 
 #include <time.h>
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
 #include "ccan/htable/htable.h"
 #include "ccan/hash/hash.h"
 #include "libmapi/mapicode.h"
@@ -29,27 +32,59 @@
 #include "libmapi/libmapi_private.h"
 
 
-/* Items stored on ht table */
-struct conn_v {
-	MYSQL		*conn;
-	const char	*connection_string;
+/* Connection of a pool */
+struct mysql_pool_conn {
+	MYSQL			*conn;
+	struct mysql_pool	*pool;
+	uint32_t		users;
+	uint32_t		failures;
+	struct timespec		last_used;
+	struct timespec		next_retry;
+	MYSQL_STMT		**stmts;
+	uint32_t		stmts_count;
+};
+
+/* Items stored on ht table: the pool of connections of a connection string */
+struct mysql_pool {
+	const char		*connection_string;
+	struct mysql_pool_conn	**conns;
+	uint32_t		count;
+	struct mysql_pool_stats	stats;
 };
 
 /* Rehash function for ht table */
 static size_t _ht_rehash(const void *e, void *unused)
 {
-	return hash_string(((struct conn_v *)e)->connection_string);
+	return hash_string(((struct mysql_pool *)e)->connection_string);
 }
 
 /* Comparison function to get items from ht table */
 static bool _ht_cmp(const void *e, void *string)
 {
-	return strcmp(((struct conn_v *)e)->connection_string, (const char *)string) == 0;
+	return strcmp(((struct mysql_pool *)e)->connection_string, (const char *)string) == 0;
+}
+
+/* Rehash function for conn_ht table */
+static size_t _conn_ht_rehash(const void *e, void *unused)
+{
+	return hash_pointer(((struct mysql_pool_conn *)e)->conn, 0);
+}
+
+/* Comparison function to get items from conn_ht table */
+static bool _conn_ht_cmp(const void *e, void *conn)
+{
+	return ((struct mysql_pool_conn *)e)->conn == conn;
 }
 
-/* This is a dictionary [connection_string] -> [MYSQL *] (actually struct conn_v) */
+/* This is a dictionary [connection_string] -> [struct mysql_pool] */
 static struct htable ht = HTABLE_INITIALIZER(ht, _ht_rehash, NULL);
 
+/* This is a dictionary [MYSQL *] -> [struct mysql_pool_conn] */
+static struct htable conn_ht = HTABLE_INITIALIZER(conn_ht, _conn_ht_rehash, NULL);
+
+/* Maximum number of connections opened per connection string */
+static uint32_t pool_size = MYSQL_POOL_SIZE;
+
 
 static float timespec_diff_in_seconds(struct timespec *end, struct timespec *start)
 {
@@ -58,20 +93,87 @@ static float timespec_diff_in_seconds(struct timespec *end, struct timespec *sta
 		/ 1000000000;
 }
 
+static uint64_t timespec_diff_in_usec(const struct timespec *end, const struct timespec *start)
+{
+	return (end->tv_sec - start->tv_sec) * 1000000 +
+		(end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+/**
+   \details Set the maximum number of connections opened per
+   connection string. Only pools growing afterwards are affected.
+
+   \param size the pool size, 0 restores the default value
+ */
+void mysql_pool_set_size(uint32_t size)
+{
+	pool_size = size ? size : MYSQL_POOL_SIZE;
+}
+
+/**
+   \details Retrieve the metrics of the pool serving a connection
+   string
+
+   \param connection_string the connection string of the pool
+   \param stats pointer to the structure to fill
+
+   \return true on success, false if there is no pool for this
+   connection string
+ */
+bool mysql_pool_get_stats(const char *connection_string, struct mysql_pool_stats *stats)
+{
+	struct mysql_pool	*pool;
+
+	if (!connection_string || !stats) return false;
+
+	pool = htable_get(&ht, hash_string(connection_string), _ht_cmp, connection_string);
+	if (!pool) return false;
+
+	*stats = pool->stats;
+	return true;
+}
+
+/**
+   \details Close the prepared statements cached for a connection
+
+   \param slot pointer to the pool slot owning the connection
+ */
+static void pool_conn_close_stmts(struct mysql_pool_conn *slot)
+{
+	uint32_t	i;
+
+	for (i = 0; i < slot->stmts_count; i++) {
+		if (slot->stmts[i]) {
+			mysql_stmt_close(slot->stmts[i]);
+		}
+	}
+	talloc_free(slot->stmts);
+	slot->stmts = NULL;
+	slot->stmts_count = 0;
+}
+
 /**
     \details Close and delete all mysql connections already open
  */
 void close_all_connections(void)
 {
 	struct htable_iter 	i;
-	struct conn_v		*entry;
+	struct mysql_pool	*entry;
+	uint32_t		j;
 
 	entry = htable_first(&ht, &i);
 	while (entry) {
 		OC_DEBUG(3, "Closing %s", entry->connection_string);
-		mysql_close(entry->conn);
+		for (j = 0; j < entry->count; j++) {
+			if (entry->conns[j]->conn) {
+				pool_conn_close_stmts(entry->conns[j]);
+				mysql_close(entry->conns[j]->conn);
+			}
+		}
+		talloc_free(entry);
 		entry = htable_next(&ht, &i);
 	}
+	htable_clear(&conn_ht);
 	htable_clear(&ht);
 }
 
@@ -199,23 +301,22 @@ static bool parse_connection_string(TALLOC_CTX *mem_ctx,
 }
 
 
-MYSQL *create_connection(const char *connection_string, MYSQL **conn)
+/**
+   \details Open a new connection to the server, creating the database
+   if it does not exist yet
+
+   \param connection_string mysql connection string
+
+   \return the connection on success, otherwise NULL
+ */
+static MYSQL *open_connection(const char *connection_string)
 {
 	TALLOC_CTX	*mem_ctx;
+	MYSQL		*conn = NULL;
 	my_bool		reconnect;
 	char		*host, *user, *passwd, *db, *sql;
 	int		port;
 	bool		parsed;
-	struct conn_v	*entry = NULL, *retval = NULL;
-
-	if (conn == NULL) return NULL;
-
-	retval = htable_get(&ht, hash_string(connection_string), _ht_cmp, connection_string);
-	if (retval) {
-		OC_DEBUG(5, "[MYSQL] Found connection, reusing it %"PRIu32, hash_string(connection_string));
-		*conn = retval->conn;
-		return *conn;
-	}
 
 	mem_ctx = talloc_zero(NULL, TALLOC_CTX);
 	if (!mem_ctx) return NULL;
@@ -224,77 +325,269 @@ MYSQL *create_connection(const char *connection_string, MYSQL **conn)
 					 &host, &port, &user, &passwd, &db);
 	if (!parsed) {
 		OC_DEBUG(1, "[MYSQL] Wrong connection string %s", connection_string);
-		*conn = NULL;
 		goto end;
 	}
 
-	*conn = mysql_init(NULL);
+	conn = mysql_init(NULL);
 
 	reconnect = true;
-	if (mysql_options(*conn, MYSQL_OPT_RECONNECT, &reconnect)) {
+	if (mysql_options(conn, MYSQL_OPT_RECONNECT, &reconnect)) {
 		OC_DEBUG(1, "[MYSQL] Can't set MYSQL_OPT_RECONNECT option");
 	}
 
 	// First try to connect to the database, if it fails try to create it
-	if (mysql_real_connect(*conn, host, user, passwd, db, port, NULL, 0)) {
+	if (mysql_real_connect(conn, host, user, passwd, db, port, NULL, 0)) {
 		OC_DEBUG(5, "[MYSQL] Connection done");
-		goto connected;
+		goto end;
 	}
 
 	// Try to create database
-	if (!mysql_real_connect(*conn, host, user, passwd, NULL, port, NULL, 0)) {
+	if (!mysql_real_connect(conn, host, user, passwd, NULL, port, NULL, 0)) {
 		// Nop
 		OC_DEBUG(1, "[MYSQL] Can't connect to server using %s, error: %s",
-			  connection_string, mysql_error(*conn));
-		mysql_close(*conn);
-		*conn = NULL;
-		goto end;
+			  connection_string, mysql_error(conn));
+		mysql_close(conn);
+		conn = NULL;
 	} else {
 		OC_DEBUG(5, "[MYSQL] Connection done, let's create the database");
 		// Connect it!, let's try to create database
 		sql = talloc_asprintf(mem_ctx, "CREATE DATABASE %s", db);
-		if (mysql_query(*conn, sql) != 0 || mysql_select_db(*conn, db) != 0) {
+		if (mysql_query(conn, sql) != 0 || mysql_select_db(conn, db) != 0) {
 			OC_DEBUG(1, "[MYSQL] Can't connect to server using %s, error: %s",
-				  connection_string, mysql_error(*conn));
-			mysql_close(*conn);
-			*conn = NULL;
-			goto end;
+				  connection_string, mysql_error(conn));
+			mysql_close(conn);
+			conn = NULL;
+		}
+	}
+
+end:
+	talloc_free(mem_ctx);
+	return conn;
+}
+
+/**
+   \details (Re)open the connection of a pool slot, unless the slot
+   is still waiting for its reconnection backoff to expire
+
+   \param slot pointer to the pool slot
+   \param now the current time
+
+   \return true if the slot holds an open connection, otherwise false
+ */
+static bool pool_conn_open(struct mysql_pool_conn *slot, const struct timespec *now)
+{
+	uint64_t	backoff_ms;
+
+	if (slot->failures && (now->tv_sec < slot->next_retry.tv_sec ||
+			       (now->tv_sec == slot->next_retry.tv_sec &&
+				now->tv_nsec < slot->next_retry.tv_nsec))) {
+		return false;
+	}
+
+	slot->conn = open_connection(slot->pool->connection_string);
+	if (!slot->conn) {
+		/* Exponential backoff: 100ms, 200ms, 400ms ... up to the maximum */
+		slot->failures++;
+		backoff_ms = MYSQL_POOL_BACKOFF_MIN_MS << (slot->failures < 16 ? slot->failures - 1 : 15);
+		if (backoff_ms > MYSQL_POOL_BACKOFF_MAX_MS) {
+			backoff_ms = MYSQL_POOL_BACKOFF_MAX_MS;
 		}
+		slot->next_retry = *now;
+		slot->next_retry.tv_sec += backoff_ms / 1000;
+		slot->next_retry.tv_nsec += (backoff_ms % 1000) * 1000000;
+		if (slot->next_retry.tv_nsec >= 1000000000) {
+			slot->next_retry.tv_sec++;
+			slot->next_retry.tv_nsec -= 1000000000;
+		}
+		return false;
 	}
 
-connected:
-	// This entries will never be deallocated
-	entry = talloc_zero(talloc_autofree_context(), struct conn_v);
-	entry->connection_string = talloc_strdup(entry, connection_string);
-	entry->conn = *conn;
-	// Store the new connection in our table
-	if (!htable_add(&ht, hash_string(connection_string), entry)) {
+	if (slot->failures) {
+		slot->pool->stats.reconnects++;
+	}
+	slot->failures = 0;
+	slot->last_used = *now;
+	if (!htable_add(&conn_ht, _conn_ht_rehash(slot, NULL), slot)) {
 		OC_DEBUG(1, "[MYSQL] ERROR adding new connection to internal pool of connections");
-	} else {
-		OC_DEBUG(5, "[MYSQL] Stored new connection %"PRIu32, hash_string(connection_string));
 	}
+	slot->pool->stats.size++;
 
-end:
-	talloc_free(mem_ctx);
+	return true;
+}
+
+/**
+   \details Close the connection of a pool slot after a failure
+
+   \param slot pointer to the pool slot
+ */
+static void pool_conn_close(struct mysql_pool_conn *slot)
+{
+	htable_del(&conn_ht, _conn_ht_rehash(slot, NULL), slot);
+	pool_conn_close_stmts(slot);
+	mysql_close(slot->conn);
+	slot->conn = NULL;
+	/* Make pool_conn_open retry immediately the first time */
+	slot->failures = 1;
+	slot->next_retry.tv_sec = 0;
+	slot->next_retry.tv_nsec = 0;
+	slot->pool->stats.size--;
+}
+
+/**
+   \details Check out a connection from the pool serving the given
+   connection string. Idle connections are preferred and pinged when
+   they have not been used for a while; the pool grows up to its
+   maximum size and busy connections are shared once it is reached.
+
+   \param connection_string mysql connection string
+   \param conn pointer to the connection to return
+
+   \note Connections must be given back to the pool with
+   release_connection
+
+   \return the connection on success, otherwise NULL
+ */
+MYSQL *create_connection(const char *connection_string, MYSQL **conn)
+{
+	struct mysql_pool	*pool;
+	struct mysql_pool_conn	*slot = NULL;
+	struct mysql_pool_conn	**conns;
+	struct timespec		start, now;
+	uint64_t		wait;
+	uint32_t		i;
+
+	if (conn == NULL) return NULL;
+	*conn = NULL;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	pool = htable_get(&ht, hash_string(connection_string), _ht_cmp, connection_string);
+	if (!pool) {
+		// This entries will never be deallocated
+		pool = talloc_zero(talloc_autofree_context(), struct mysql_pool);
+		if (!pool) return NULL;
+		pool->connection_string = talloc_strdup(pool, connection_string);
+		if (!pool->connection_string || !htable_add(&ht, hash_string(connection_string), pool)) {
+			OC_DEBUG(1, "[MYSQL] ERROR adding new pool of connections");
+			talloc_free(pool);
+			return NULL;
+		}
+		OC_DEBUG(5, "[MYSQL] Created new pool of connections %"PRIu32, hash_string(connection_string));
+	}
+
+	/* Step 1. Look for an idle connection, checking its health */
+	for (i = 0; i < pool->count && !slot; i++) {
+		if (pool->conns[i]->users) continue;
+		if (!pool->conns[i]->conn) {
+			if (pool_conn_open(pool->conns[i], &start)) {
+				slot = pool->conns[i];
+			}
+			continue;
+		}
+		if (start.tv_sec - pool->conns[i]->last_used.tv_sec >= MYSQL_POOL_PING_INTERVAL &&
+		    mysql_ping(pool->conns[i]->conn) != 0) {
+			OC_DEBUG(3, "[MYSQL] Connection to %s lost: %s", connection_string,
+				 mysql_error(pool->conns[i]->conn));
+			pool->stats.failed_pings++;
+			pool_conn_close(pool->conns[i]);
+			if (!pool_conn_open(pool->conns[i], &start)) continue;
+		}
+		slot = pool->conns[i];
+	}
+
+	/* Step 2. Grow the pool */
+	if (!slot && pool->count < pool_size) {
+		conns = talloc_realloc(pool, pool->conns, struct mysql_pool_conn *, pool->count + 1);
+		if (conns) {
+			pool->conns = conns;
+			slot = talloc_zero(conns, struct mysql_pool_conn);
+			if (slot) {
+				slot->pool = pool;
+				if (pool_conn_open(slot, &start)) {
+					talloc_steal(pool, slot);
+					conns[pool->count++] = slot;
+				} else {
+					talloc_free(slot);
+					slot = NULL;
+				}
+			}
+		}
+	}
+
+	/* Step 3. Share the least used connection */
+	if (!slot) {
+		for (i = 0; i < pool->count; i++) {
+			if (!pool->conns[i]->conn) continue;
+			if (!slot || pool->conns[i]->users < slot->users) {
+				slot = pool->conns[i];
+			}
+		}
+		if (slot) {
+			pool->stats.shared_checkouts++;
+		}
+	}
+
+	if (!slot) {
+		OC_DEBUG(1, "[MYSQL] No connection available for %s", connection_string);
+		return NULL;
+	}
+
+	if (!slot->users) {
+		pool->stats.in_use++;
+	}
+	slot->users++;
+	pool->stats.checkouts++;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait = timespec_diff_in_usec(&now, &start);
+	pool->stats.wait_total_usec += wait;
+	if (wait > pool->stats.wait_max_usec) {
+		pool->stats.wait_max_usec = wait;
+	}
+
+	*conn = slot->conn;
 	return *conn;
 }
 
+/**
+   \details Give a connection back to its pool
+
+   \param conn the connection obtained from create_connection
+ */
 void release_connection(MYSQL *conn)
 {
-	// Do nothing
+	struct mysql_pool_conn	*slot;
+
+	if (!conn) return;
+
+	slot = htable_get(&conn_ht, hash_pointer(conn, 0), _conn_ht_cmp, conn);
+	if (!slot || !slot->users) {
+		OC_DEBUG(1, "[MYSQL] Releasing unknown connection %p", conn);
+		return;
+	}
+
+	slot->users--;
+	if (!slot->users) {
+		slot->pool->stats.in_use--;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &slot->last_used);
 }
 
 enum MYSQLRESULT execute_query(MYSQL *conn, const char *sql)
 {
 	struct timespec start, end;
 	float seconds_spent;
+	struct oc_trace_span span;
 
+	oc_trace_span_begin(&span, __FUNCTION__, 0);
 	clock_gettime(CLOCK_MONOTONIC, &start);
 	if (mysql_query(conn, sql) != 0) {
 		OC_DEBUG(3, "Error on query `%s`: %s", sql, mysql_error(conn));
+		oc_trace_span_end(&span, MYSQL_ERROR);
 		return MYSQL_ERROR;
 	}
 	clock_gettime(CLOCK_MONOTONIC, &end);
+	oc_trace_span_end(&span, MYSQL_SUCCESS);
 
 	seconds_spent = timespec_diff_in_seconds(&end, &start);
 	if (seconds_spent > THRESHOLD_SLOW_QUERIES) {
@@ -307,6 +600,336 @@ enum MYSQLRESULT execute_query(MYSQL *conn, const char *sql)
 }
 
 
+/**
+   \details Bind a string input parameter of a prepared statement
+
+   \param bind pointer to the parameter to bind
+   \param s the string value
+   \param length pointer to the storage of the string length, must
+   remain valid until the statement is executed
+ */
+void stmt_bind_string(MYSQL_BIND *bind, const char *s, unsigned long *length)
+{
+	memset(bind, 0, sizeof(MYSQL_BIND));
+	*length = strlen(s);
+	bind->buffer_type = MYSQL_TYPE_STRING;
+	bind->buffer = (void *) s;
+	bind->buffer_length = *length;
+	bind->length = length;
+}
+
+/**
+   \details Bind an unsigned 64 bits integer input parameter of a
+   prepared statement
+
+   \param bind pointer to the parameter to bind
+   \param n pointer to the value, must remain valid until the
+   statement is executed
+ */
+void stmt_bind_uint64(MYSQL_BIND *bind, const uint64_t *n)
+{
+	memset(bind, 0, sizeof(MYSQL_BIND));
+	bind->buffer_type = MYSQL_TYPE_LONGLONG;
+	bind->buffer = (void *) n;
+	bind->is_unsigned = true;
+}
+
+/**
+   \details Retrieve the prepared statement identified by id for the
+   given connection, preparing it on first use
+
+   \param conn the connection obtained from create_connection
+   \param id the statement identifier, unique for a given sql string
+   \param sql the statement to prepare
+   \param cachedp set to true when the statement is owned by the
+   connection cache, false when the caller must close it
+
+   \return the statement on success, otherwise NULL
+ */
+static MYSQL_STMT *stmt_lookup(MYSQL *conn, uint32_t id, const char *sql, bool *cachedp)
+{
+	struct mysql_pool_conn	*slot;
+	MYSQL_STMT		**stmts;
+	MYSQL_STMT		*stmt;
+
+	slot = htable_get(&conn_ht, hash_pointer(conn, 0), _conn_ht_cmp, conn);
+	if (slot && id < slot->stmts_count && slot->stmts[id]) {
+		*cachedp = true;
+		return slot->stmts[id];
+	}
+
+	stmt = mysql_stmt_init(conn);
+	if (!stmt) return NULL;
+	if (mysql_stmt_prepare(stmt, sql, strlen(sql)) != 0) {
+		OC_DEBUG(3, "Error preparing `%s`: %s", sql, mysql_stmt_error(stmt));
+		mysql_stmt_close(stmt);
+		return NULL;
+	}
+
+	*cachedp = false;
+	if (slot) {
+		if (id >= slot->stmts_count) {
+			stmts = talloc_realloc(slot, slot->stmts, MYSQL_STMT *, id + 1);
+			if (!stmts) return stmt;
+			memset(stmts + slot->stmts_count, 0,
+			       (id + 1 - slot->stmts_count) * sizeof(MYSQL_STMT *));
+			slot->stmts = stmts;
+			slot->stmts_count = id + 1;
+		}
+		slot->stmts[id] = stmt;
+		*cachedp = true;
+	}
+
+	return stmt;
+}
+
+/**
+   \details Drop a prepared statement from the connection cache
+
+   \param conn the connection owning the statement
+   \param id the statement identifier
+ */
+static void stmt_forget(MYSQL *conn, uint32_t id)
+{
+	struct mysql_pool_conn	*slot;
+
+	slot = htable_get(&conn_ht, hash_pointer(conn, 0), _conn_ht_cmp, conn);
+	if (slot && id < slot->stmts_count && slot->stmts[id]) {
+		mysql_stmt_close(slot->stmts[id]);
+		slot->stmts[id] = NULL;
+	}
+}
+
+/**
+   \details Execute a cached prepared statement, preparing it again
+   once if the server has lost it (reconnection, schema change)
+
+   \param conn the connection obtained from create_connection
+   \param id the statement identifier, unique for a given sql string
+   \param sql the statement to prepare
+   \param params the input parameters, NULL if there is none
+   \param stmtp pointer to the executed statement to return
+   \param cachedp set to false when the caller must close the statement
+
+   \return MYSQL_SUCCESS on success, otherwise MYSQL_ERROR
+ */
+static enum MYSQLRESULT stmt_execute_prepared(MYSQL *conn, uint32_t id, const char *sql,
+					      MYSQL_BIND *params, MYSQL_STMT **stmtp,
+					      bool *cachedp)
+{
+	struct timespec	start, end;
+	float		seconds_spent;
+	MYSQL_STMT	*stmt;
+	unsigned int	err;
+	int		attempt;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (attempt = 0; attempt < 2; attempt++) {
+		stmt = stmt_lookup(conn, id, sql, cachedp);
+		if (!stmt) return MYSQL_ERROR;
+
+		if ((!params || !mysql_stmt_bind_param(stmt, params)) &&
+		    !mysql_stmt_execute(stmt)) {
+			break;
+		}
+
+		err = mysql_stmt_errno(stmt);
+		OC_DEBUG(3, "Error on statement `%s`: %s", sql, mysql_stmt_error(stmt));
+		if (*cachedp) {
+			stmt_forget(conn, id);
+		} else {
+			mysql_stmt_close(stmt);
+		}
+		if (err != CR_SERVER_GONE_ERROR && err != CR_SERVER_LOST &&
+		    err != ER_UNKNOWN_STMT_HANDLER && err != ER_NEED_REPREPARE) {
+			return MYSQL_ERROR;
+		}
+		stmt = NULL;
+	}
+	if (!stmt) return MYSQL_ERROR;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	seconds_spent = timespec_diff_in_seconds(&end, &start);
+	if (seconds_spent > THRESHOLD_SLOW_QUERIES) {
+		OC_DEBUG(5, "MySQL slow statement!"
+			  "\tQuery: `%s`\n\tTime: %.3f\n", sql, seconds_spent);
+	}
+
+	*stmtp = stmt;
+	return MYSQL_SUCCESS;
+}
+
+/* Execute a prepared statement within a span of the current trace,
+   the statement identifier tells the queries apart */
+static enum MYSQLRESULT stmt_execute_internal(MYSQL *conn, uint32_t id, const char *sql,
+					      MYSQL_BIND *params, MYSQL_STMT **stmtp,
+					      bool *cachedp)
+{
+	struct oc_trace_span	span;
+	enum MYSQLRESULT	ret;
+
+	oc_trace_span_begin(&span, "stmt_execute", id);
+	ret = stmt_execute_prepared(conn, id, sql, params, stmtp, cachedp);
+	oc_trace_span_end(&span, ret);
+
+	return ret;
+}
+
+/* Discard any pending row and release the statement if not cached */
+static void stmt_done(MYSQL_STMT *stmt, bool cached)
+{
+	mysql_stmt_free_result(stmt);
+	mysql_stmt_reset(stmt);
+	if (!cached) {
+		mysql_stmt_close(stmt);
+	}
+}
+
+/**
+   \details Execute a prepared statement which returns no result set
+
+   \param conn the connection obtained from create_connection
+   \param id the statement identifier, unique for a given sql string
+   \param sql the statement to prepare
+   \param params the input parameters, NULL if there is none
+   \param affected_rows pointer to the number of rows changed, may be NULL
+
+   \return MYSQL_SUCCESS on success, otherwise MYSQL_ERROR
+ */
+enum MYSQLRESULT stmt_execute(MYSQL *conn, uint32_t id, const char *sql,
+			      MYSQL_BIND *params, uint64_t *affected_rows)
+{
+	MYSQL_STMT		*stmt;
+	enum MYSQLRESULT	ret;
+	bool			cached;
+
+	ret = stmt_execute_internal(conn, id, sql, params, &stmt, &cached);
+	if (ret != MYSQL_SUCCESS) return ret;
+
+	if (affected_rows) {
+		*affected_rows = mysql_stmt_affected_rows(stmt);
+	}
+	stmt_done(stmt, cached);
+	return MYSQL_SUCCESS;
+}
+
+/**
+   \details Execute a prepared statement and retrieve the first
+   columns of its first row as unsigned integers
+
+   \param conn the connection obtained from create_connection
+   \param id the statement identifier, unique for a given sql string
+   \param sql the statement to prepare
+   \param params the input parameters, NULL if there is none
+   \param count the number of columns to retrieve
+   \param n array of count values to fill
+
+   \return MYSQL_SUCCESS on success, MYSQL_NOT_FOUND if there is no
+   row, otherwise MYSQL_ERROR
+ */
+enum MYSQLRESULT stmt_select_first_uints(MYSQL *conn, uint32_t id, const char *sql,
+					 MYSQL_BIND *params, uint32_t count, uint64_t *n)
+{
+	MYSQL_STMT		*stmt;
+	MYSQL_BIND		result[count];
+	my_bool			is_null[count];
+	enum MYSQLRESULT	ret;
+	bool			cached;
+	uint32_t		i;
+	int			fetched;
+
+	ret = stmt_execute_internal(conn, id, sql, params, &stmt, &cached);
+	if (ret != MYSQL_SUCCESS) return ret;
+
+	memset(result, 0, sizeof(result));
+	for (i = 0; i < count; i++) {
+		result[i].buffer_type = MYSQL_TYPE_LONGLONG;
+		result[i].buffer = &n[i];
+		result[i].is_unsigned = true;
+		result[i].is_null = &is_null[i];
+	}
+
+	ret = MYSQL_ERROR;
+	if (mysql_stmt_bind_result(stmt, result) == 0) {
+		fetched = mysql_stmt_fetch(stmt);
+		if (fetched == MYSQL_NO_DATA) {
+			ret = MYSQL_NOT_FOUND;
+		} else if (fetched == 0) {
+			ret = MYSQL_SUCCESS;
+			for (i = 0; i < count; i++) {
+				if (is_null[i]) ret = MYSQL_ERROR;
+			}
+		}
+	}
+
+	stmt_done(stmt, cached);
+	return ret;
+}
+
+/**
+   \details Execute a prepared statement and retrieve the first
+   column of its first row as a string
+
+   \param mem_ctx pointer to the memory context
+   \param conn the connection obtained from create_connection
+   \param id the statement identifier, unique for a given sql string
+   \param sql the statement to prepare
+   \param params the input parameters, NULL if there is none
+   \param s pointer to the string to return
+
+   \return MYSQL_SUCCESS on success, MYSQL_NOT_FOUND if there is no
+   row, otherwise MYSQL_ERROR
+ */
+enum MYSQLRESULT stmt_select_first_string(TALLOC_CTX *mem_ctx, MYSQL *conn, uint32_t id,
+					  const char *sql, MYSQL_BIND *params, const char **s)
+{
+	MYSQL_STMT		*stmt;
+	MYSQL_BIND		result;
+	unsigned long		length = 0;
+	my_bool			is_null = false;
+	enum MYSQLRESULT	ret;
+	char			*value;
+	bool			cached;
+	int			fetched;
+
+	ret = stmt_execute_internal(conn, id, sql, params, &stmt, &cached);
+	if (ret != MYSQL_SUCCESS) return ret;
+
+	/* Fetch the length first, then the actual data */
+	memset(&result, 0, sizeof(result));
+	result.buffer_type = MYSQL_TYPE_STRING;
+	result.length = &length;
+	result.is_null = &is_null;
+
+	ret = MYSQL_ERROR;
+	if (mysql_stmt_bind_result(stmt, &result) == 0) {
+		fetched = mysql_stmt_fetch(stmt);
+		if (fetched == MYSQL_NO_DATA) {
+			ret = MYSQL_NOT_FOUND;
+		} else if (is_null) {
+			*s = NULL;
+			ret = MYSQL_SUCCESS;
+		} else if (fetched == 0 || fetched == MYSQL_DATA_TRUNCATED) {
+			value = talloc_array(mem_ctx, char, length + 1);
+			if (value) {
+				result.buffer = value;
+				result.buffer_length = length + 1;
+				if (!length || mysql_stmt_fetch_column(stmt, &result, 0, 0) == 0) {
+					value[length] = '\0';
+					*s = value;
+					ret = MYSQL_SUCCESS;
+				} else {
+					talloc_free(value);
+				}
+			}
+		}
+	}
+
+	stmt_done(stmt, cached);
+	return ret;
+}
+
+
 enum MYSQLRESULT select_without_fetch(MYSQL *conn, const char *sql,
 					    MYSQL_RES **res)
 {
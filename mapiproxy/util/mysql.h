@@ -28,8 +28,26 @@
 #include <gen_ndr/exchange.h>
 
 #define THRESHOLD_SLOW_QUERIES 0.25
+
+/* Connection pool defaults */
+#define MYSQL_POOL_SIZE			4
+#define MYSQL_POOL_PING_INTERVAL	30
+#define MYSQL_POOL_BACKOFF_MIN_MS	100
+#define MYSQL_POOL_BACKOFF_MAX_MS	30000
 #define _sql(A, B) _sql_escape(A, B, '\'')
 
+/* Metrics of the pool of connections of a connection string */
+struct mysql_pool_stats {
+	uint32_t	size;			/* open connections */
+	uint32_t	in_use;			/* connections checked out */
+	uint64_t	checkouts;
+	uint64_t	shared_checkouts;	/* checkouts served by a busy connection */
+	uint64_t	failed_pings;
+	uint64_t	reconnects;
+	uint64_t	wait_total_usec;	/* time spent checking out connections */
+	uint64_t	wait_max_usec;
+};
+
 const char* _sql_escape(TALLOC_CTX *mem_ctx, const char *s, char c);
 
 enum MYSQLRESULT execute_query(MYSQL *, const char *);
@@ -38,6 +56,14 @@ enum MYSQLRESULT select_all_strings(TALLOC_CTX *, MYSQL *, const char *, struct
 enum MYSQLRESULT select_first_string(TALLOC_CTX *, MYSQL *, const char *, const char **);
 enum MYSQLRESULT select_first_uint(MYSQL *conn, const char *sql, uint64_t *n);
 
+/* Prepared statements are cached per connection by id, callers
+   sharing a connection string must use distinct ids */
+void stmt_bind_string(MYSQL_BIND *, const char *, unsigned long *);
+void stmt_bind_uint64(MYSQL_BIND *, const uint64_t *);
+enum MYSQLRESULT stmt_execute(MYSQL *, uint32_t, const char *, MYSQL_BIND *, uint64_t *);
+enum MYSQLRESULT stmt_select_first_uints(MYSQL *, uint32_t, const char *, MYSQL_BIND *, uint32_t, uint64_t *);
+enum MYSQLRESULT stmt_select_first_string(TALLOC_CTX *, MYSQL *, uint32_t, const char *, MYSQL_BIND *, const char **);
+
 bool table_exists(MYSQL *, char *);
 bool create_schema(MYSQL *, const char *);
 bool convert_string_to_ull(const char *, uint64_t *);
@@ -45,6 +71,8 @@ bool convert_string_to_ull(const char *, uint64_t *);
 MYSQL *create_connection(const char *, MYSQL **);
 void release_connection(MYSQL *);
 void close_all_connections(void);
+void mysql_pool_set_size(uint32_t);
+bool mysql_pool_get_stats(const char *, struct mysql_pool_stats *);
 
 enum MYSQLRESULT { MYSQL_SUCCESS, MYSQL_NOT_FOUND, MYSQL_ERROR };
 
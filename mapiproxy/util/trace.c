@@ -0,0 +1,278 @@
+/*
+   Request tracing util functions
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+   \file trace.c
+
+   \brief Sampled request tracing
+
+   One request every mapiproxy:trace_sample is traced. Its spans
+   (NDR pull, dispatch, ROPs, mapistore and MySQL calls...) share the
+   trace identifier drawn when the request begins and are written, one
+   JSON object per line, to the file mapiproxy:trace_file or as UDP
+   datagrams to mapiproxy:trace_udp. Spans are emitted when they end
+   and carry their start on the monotonic clock, their duration in
+   microseconds and their nesting depth, so the request tree can be
+   rebuilt by the reader.
+
+   A process handles one request at a time, the current trace is
+   therefore kept in static variables.
+ */
+
+#include "trace.h"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+#define	OC_TRACE_LINE_MAX	256
+#define	OC_TRACE_ABANDONED	0xffffffff
+
+static uint32_t			oc_trace_sample = 0;
+static int			oc_trace_fd = -1;
+static bool			oc_trace_datagram = false;
+static uint64_t			oc_trace_requests = 0;
+static uint64_t			oc_trace_seq = 0;
+
+/* Trace of the request being processed */
+static uint64_t			oc_trace_id = 0;
+static uint32_t			oc_trace_depth = 0;
+static struct oc_trace_span	oc_trace_request;
+
+
+static int oc_trace_open_udp(const char *target)
+{
+	struct addrinfo	hints;
+	struct addrinfo	*res;
+	char		*host;
+	char		*port;
+	int		fd;
+	int		ret;
+
+	host = talloc_strdup(NULL, target);
+	if (!host) return -1;
+
+	port = strrchr(host, ':');
+	if (!port) {
+		OC_DEBUG(0, "Invalid trace UDP target '%s', expected host:port", target);
+		talloc_free(host);
+		return -1;
+	}
+	*port++ = '\0';
+
+	memset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	ret = getaddrinfo(host, port, &hints, &res);
+	talloc_free(host);
+	if (ret != 0) {
+		OC_DEBUG(0, "Unable to resolve trace UDP target '%s': %s", target, gai_strerror(ret));
+		return -1;
+	}
+
+	fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd != -1 && connect(fd, res->ai_addr, res->ai_addrlen) == -1) {
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd == -1) {
+		OC_DEBUG(0, "Unable to open trace UDP socket to '%s': %s", target, strerror(errno));
+	}
+	return fd;
+}
+
+
+/**
+   \details Read the tracing configuration and open its sink
+
+   \param lp_ctx pointer to the loadparm context
+
+   Tracing is disabled unless mapiproxy:trace_sample is set together
+   with either mapiproxy:trace_file or mapiproxy:trace_udp.
+ */
+_PUBLIC_ void oc_trace_init(struct loadparm_context *lp_ctx)
+{
+	const char	*file;
+	const char	*udp;
+	int		sample;
+
+	if (oc_trace_fd != -1) return;
+
+	sample = lpcfg_parm_int(lp_ctx, NULL, "mapiproxy", "trace_sample", 0);
+	if (sample <= 0) return;
+
+	file = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "trace_file");
+	udp = lpcfg_parm_string(lp_ctx, NULL, "mapiproxy", "trace_udp");
+	if (udp) {
+		oc_trace_fd = oc_trace_open_udp(udp);
+		oc_trace_datagram = true;
+	} else if (file) {
+		oc_trace_fd = open(file, O_WRONLY|O_APPEND|O_CREAT, 0640);
+		if (oc_trace_fd == -1) {
+			OC_DEBUG(0, "Unable to open trace file %s: %s", file, strerror(errno));
+		}
+	} else {
+		OC_DEBUG(0, "mapiproxy:trace_sample is set without trace_file or trace_udp");
+	}
+	if (oc_trace_fd == -1) return;
+
+	oc_trace_sample = sample;
+	oc_trace_seq = (uint64_t)time(NULL) << 8;
+	OC_DEBUG(3, "Tracing one request every %d", sample);
+}
+
+
+static void oc_trace_emit(const struct oc_trace_span *span, uint32_t status)
+{
+	struct timespec	end;
+	char		line[OC_TRACE_LINE_MAX];
+	uint64_t	start_usec;
+	uint64_t	usec;
+	int		len;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	start_usec = (uint64_t)span->start.tv_sec * 1000000 + span->start.tv_nsec / 1000;
+	usec = (uint64_t)(end.tv_sec - span->start.tv_sec) * 1000000 +
+		(end.tv_nsec - span->start.tv_nsec) / 1000;
+
+	len = snprintf(line, sizeof (line),
+		       "{\"trace\":\"%016" PRIx64 "\",\"pid\":%d,\"span\":\"%s\",\"op\":%u,"
+		       "\"depth\":%u,\"start\":%" PRIu64 ",\"duration\":%" PRIu64 ",\"status\":%u}\n",
+		       oc_trace_id, (int)getpid(), span->name, span->op, span->depth,
+		       start_usec, usec, status);
+	if (len <= 0) return;
+	if ((size_t)len >= sizeof (line)) {
+		len = sizeof (line) - 1;
+		line[len - 1] = '\n';
+	}
+
+	/* Lines are short enough for O_APPEND writes from several
+	   processes not to interleave */
+	if (oc_trace_datagram) {
+		send(oc_trace_fd, line, len, MSG_DONTWAIT);
+	} else if (write(oc_trace_fd, line, len) == -1) {
+		OC_DEBUG(5, "Unable to write trace: %s", strerror(errno));
+	}
+}
+
+
+/**
+   \details Begin a request and decide whether it is traced
+
+   \param name the name of the root span of the request
+   \param op the operation number of the request
+
+   A request still open, because it failed before reaching
+   oc_trace_request_end, is ended with an abandoned status.
+
+   \return true if the request is traced, otherwise false
+ */
+_PUBLIC_ bool oc_trace_request_begin(const char *name, uint32_t op)
+{
+	if (!oc_trace_sample) return false;
+
+	if (oc_trace_id) {
+		oc_trace_request_end(OC_TRACE_ABANDONED);
+	}
+
+	if (++oc_trace_requests % oc_trace_sample) {
+		return false;
+	}
+
+	oc_trace_id = ((uint64_t)getpid() << 40) | (++oc_trace_seq & 0xffffffffffULL);
+	oc_trace_depth = 0;
+	oc_trace_span_begin(&oc_trace_request, name, op);
+
+	return true;
+}
+
+
+/**
+   \details End the current request
+
+   \param status the status the request ended with
+ */
+_PUBLIC_ void oc_trace_request_end(uint32_t status)
+{
+	if (!oc_trace_id) return;
+
+	oc_trace_span_end(&oc_trace_request, status);
+	oc_trace_id = 0;
+}
+
+
+/**
+   \details Return the trace identifier of the current request
+
+   \return the identifier, 0 if the request is not traced
+ */
+_PUBLIC_ uint64_t oc_trace_current_id(void)
+{
+	return oc_trace_id;
+}
+
+
+/**
+   \details Begin a span of the current request
+
+   Does nothing but mark the span inactive when the request is not
+   traced.
+
+   \param span pointer to the span to begin
+   \param name the span name, must remain valid until the span ends
+   \param op an operation number qualifying the span, 0 if none
+ */
+_PUBLIC_ void oc_trace_span_begin(struct oc_trace_span *span, const char *name, uint32_t op)
+{
+	span->active = (oc_trace_id != 0);
+	if (!span->active) return;
+
+	span->name = name;
+	span->op = op;
+	span->depth = oc_trace_depth++;
+	clock_gettime(CLOCK_MONOTONIC, &span->start);
+}
+
+
+/**
+   \details End a span and write it to the sink
+
+   \param span pointer to the span begun with oc_trace_span_begin
+   \param status the status the spanned operation returned
+ */
+_PUBLIC_ void oc_trace_span_end(struct oc_trace_span *span, uint32_t status)
+{
+	if (!span->active || !oc_trace_id) return;
+
+	span->active = false;
+	if (oc_trace_depth) {
+		oc_trace_depth--;
+	}
+	oc_trace_emit(span, status);
+}
@@ -0,0 +1,48 @@
+/*
+   Request tracing util functions
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+struct loadparm_context;
+
+/* A timed section of a traced request. Spans are stack allocated by
+   the caller and written to the sink when they end. */
+struct oc_trace_span {
+	const char		*name;
+	uint32_t		op;
+	uint32_t		depth;
+	bool			active;
+	struct timespec		start;
+};
+
+void oc_trace_init(struct loadparm_context *);
+bool oc_trace_request_begin(const char *, uint32_t);
+void oc_trace_request_end(uint32_t);
+uint64_t oc_trace_current_id(void);
+void oc_trace_span_begin(struct oc_trace_span *, const char *, uint32_t);
+void oc_trace_span_end(struct oc_trace_span *, uint32_t);
+
+#endif /* __TRACE_H__ */
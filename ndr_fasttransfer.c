@@ -183,13 +183,12 @@ static void ndr_print_IDSET(struct ndr_print *ndr, const struct idset *idset,
 		}
 
 		ndr->depth++;
-		range = idset->ranges;
 		for (i = 0; i < idset->range_count; i++) {
+			range = idset->ranges + i;
 			if (exchange_globcnt(range->low) > exchange_globcnt(range->high)) {
 				ndr->print(ndr, COLOR_BOLD COLOR_RED "Incorrect GLOBCNT range as high value is larger than low value" COLOR_END COLOR_END);
 			}
 			ndr->print(ndr, COLOR_CYAN "0x%.12" PRIx64 ":0x%.12" PRIx64 COLOR_END, range->low, range->high);
-			range = range->next;
 		}
 		ndr->depth--;
 
@@ -47,6 +47,42 @@ ssize_t lzxpress_decompress(const uint8_t *input,
 			    uint8_t *output,
 			    uint32_t max_output_size);
 
+/**
+   \details Compress a blob with LZ77 (LZXPRESS) in a single stream,
+   as expected in a RPC_HEADER_EXT payload flagged RHEF_Compressed
+
+   \param mem_ctx pointer to the memory context
+   \param plain pointer to the data to compress
+   \param comp pointer to the compressed data to return, allocated
+   under mem_ctx
+
+   \return true if the data was compressed to a smaller size, otherwise
+   false and comp is left untouched
+ */
+_PUBLIC_ bool lzxpress_compress_blob(TALLOC_CTX *mem_ctx, const DATA_BLOB *plain, DATA_BLOB *comp)
+{
+	uint8_t		*data;
+	uint32_t	max_size;
+	ssize_t		ret;
+
+	if (!plain || !plain->length || !comp) return false;
+
+	/* Incompressible data grows by a 4 bytes indicator every 32 bytes */
+	max_size = plain->length + plain->length / 8 + 8;
+	data = talloc_array(mem_ctx, uint8_t, max_size);
+	if (!data) return false;
+
+	ret = lzxpress_compress(plain->data, plain->length, data, max_size);
+	if (ret <= 0 || (size_t)ret >= plain->length) {
+		talloc_free(data);
+		return false;
+	}
+
+	comp->data = data;
+	comp->length = ret;
+	return true;
+}
+
 /**
    \details Compress a LZXPRESS chunk
 
@@ -232,6 +268,8 @@ _PUBLIC_ enum ndr_err_code ndr_pull_mapi2k7_request(struct ndr_pull *ndr, int nd
 						obfuscate_data(_ndr_buffer->data, _ndr_buffer->data_size, 0xA5);
 						NDR_CHECK(ndr_pull_lzxpress_decompress(_ndr_buffer, &_ndr_data_compressed, r->header.SizeActual));
 						NDR_CHECK(ndr_pull_mapi_request(_ndr_data_compressed, NDR_SCALARS|NDR_BUFFERS, r->mapi_request));
+						/* ROP payloads are views into the decompressed data */
+						talloc_steal(r->mapi_request, _ndr_data_compressed->data);
 						_ndr_buffer->offset = _ndr_buffer->data_size;
 					} else if ((r->header.Flags  == RHEF_Compressed) ||
 						   (r->header.Flags == (RHEF_Compressed|RHEF_Last))) {
@@ -239,6 +277,7 @@ _PUBLIC_ enum ndr_err_code ndr_pull_mapi2k7_request(struct ndr_pull *ndr, int nd
 
 						NDR_CHECK(ndr_pull_lzxpress_decompress(_ndr_buffer, &_ndr_data_compressed, r->header.SizeActual));
 						NDR_CHECK(ndr_pull_mapi_request(_ndr_data_compressed, NDR_SCALARS|NDR_BUFFERS, r->mapi_request));
+						talloc_steal(r->mapi_request, _ndr_data_compressed->data);
 						_ndr_buffer->offset = _ndr_buffer->data_size;
 					} else if ((r->header.Flags == RHEF_XorMagic) ||
 						   (r->header.Flags == (RHEF_XorMagic|RHEF_Last))) {
@@ -278,6 +317,10 @@ _PUBLIC_ enum ndr_err_code ndr_pull_mapi2k7_response(struct ndr_pull *ndr, int n
 					if (r->header.Flags & RHEF_Compressed) {
 						struct ndr_pull *_ndr_data_compressed = NULL;
 
+						/* Obfuscation applies to the compressed payload */
+						if (r->header.Flags & RHEF_XorMagic) {
+							obfuscate_data(_ndr_buffer->data, _ndr_buffer->data_size, 0xA5);
+						}
 						NDR_CHECK(ndr_pull_lzxpress_decompress(_ndr_buffer, &_ndr_data_compressed, r->header.SizeActual));
 						NDR_CHECK(ndr_pull_mapi_response(_ndr_data_compressed, NDR_SCALARS|NDR_BUFFERS, r->mapi_response));
 					} else if (r->header.Flags & RHEF_XorMagic) {
@@ -585,6 +628,356 @@ void ndr_print_mapi_response(struct ndr_print *ndr, const char *name, const stru
 	}
 }
 
+/*
+  Fast codecs for the most frequent ROPs
+
+  Release, GetPropertiesSpecific, QueryRows, ReadStream and
+  FastTransferSourceGetBuffer make up most of the EcDoRpc traffic. The
+  functions below encode and decode their requests and successful
+  replies with a single bounds check, instead of going through the
+  generated union code field by field.
+
+  They return false for any other ROP, or when the buffer is too short,
+  without having consumed or written anything. The caller then falls
+  back to the generic functions, which produce the same bytes and
+  report the error if there is one.
+*/
+
+static inline void ndr_fast_put_uint16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static inline void ndr_fast_put_uint32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = (v >> 8) & 0xFF;
+	p[2] = (v >> 16) & 0xFF;
+	p[3] = v >> 24;
+}
+
+static inline uint16_t ndr_fast_get_uint16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t ndr_fast_get_uint32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool ndr_push_EcDoRpc_MAPI_REQ_fast(struct ndr_push *ndr, const struct EcDoRpc_MAPI_REQ *r)
+{
+	uint32_t	size = 3;
+	uint32_t	i;
+	uint8_t		*p;
+
+	if (ndr->flags & LIBNDR_FLAG_BIGENDIAN) return false;
+
+	switch (r->opnum) {
+	case op_MAPI_Release:
+		break;
+	case op_MAPI_GetProps:
+		size += 6 + r->u.mapi_GetProps.prop_count * sizeof (uint32_t);
+		break;
+	case op_MAPI_QueryRows:
+		size += 4;
+		break;
+	case op_MAPI_ReadStream:
+		size += (r->u.mapi_ReadStream.ByteCount == 0xBABE) ? 6 : 2;
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		size += (r->u.mapi_FastTransferSourceGetBuffer.BufferSize == 0xBABE) ? 4 : 2;
+		break;
+	default:
+		return false;
+	}
+
+	if (ndr_push_expand(ndr, size) != NDR_ERR_SUCCESS) return false;
+	p = ndr->data + ndr->offset;
+	p[0] = r->opnum;
+	p[1] = r->logon_id;
+	p[2] = r->handle_idx;
+	p += 3;
+
+	switch (r->opnum) {
+	case op_MAPI_GetProps:
+		ndr_fast_put_uint16(p, r->u.mapi_GetProps.PropertySizeLimit);
+		ndr_fast_put_uint16(p + 2, r->u.mapi_GetProps.WantUnicode);
+		ndr_fast_put_uint16(p + 4, r->u.mapi_GetProps.prop_count);
+		for (i = 0; i < r->u.mapi_GetProps.prop_count; i++) {
+			ndr_fast_put_uint32(p + 6 + i * 4, r->u.mapi_GetProps.properties[i]);
+		}
+		break;
+	case op_MAPI_QueryRows:
+		p[0] = r->u.mapi_QueryRows.QueryRowsFlags;
+		p[1] = r->u.mapi_QueryRows.ForwardRead;
+		ndr_fast_put_uint16(p + 2, r->u.mapi_QueryRows.RowCount);
+		break;
+	case op_MAPI_ReadStream:
+		ndr_fast_put_uint16(p, r->u.mapi_ReadStream.ByteCount);
+		if (r->u.mapi_ReadStream.ByteCount == 0xBABE) {
+			ndr_fast_put_uint32(p + 2, r->u.mapi_ReadStream.MaximumByteCount.value);
+		}
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		ndr_fast_put_uint16(p, r->u.mapi_FastTransferSourceGetBuffer.BufferSize);
+		if (r->u.mapi_FastTransferSourceGetBuffer.BufferSize == 0xBABE) {
+			ndr_fast_put_uint16(p + 2, r->u.mapi_FastTransferSourceGetBuffer.MaximumBufferSize.MaximumBufferSize);
+		}
+		break;
+	default:
+		break;
+	}
+	ndr->offset += size;
+
+	return true;
+}
+
+static bool ndr_pull_EcDoRpc_MAPI_REQ_fast(struct ndr_pull *ndr, struct EcDoRpc_MAPI_REQ *r)
+{
+	const uint8_t	*p;
+	uint32_t	avail;
+	uint32_t	size = 3;
+	uint32_t	i;
+	uint16_t	count = 0;
+	enum MAPITAGS	*properties = NULL;
+
+	if (ndr->flags & LIBNDR_FLAG_BIGENDIAN) return false;
+	if (ndr->offset >= ndr->data_size) return false;
+	avail = ndr->data_size - ndr->offset;
+	if (avail < size) return false;
+	p = ndr->data + ndr->offset;
+
+	switch (p[0]) {
+	case op_MAPI_Release:
+		break;
+	case op_MAPI_GetProps:
+		if (avail < 9) return false;
+		count = ndr_fast_get_uint16(p + 7);
+		size += 6 + count * sizeof (uint32_t);
+		break;
+	case op_MAPI_QueryRows:
+		size += 4;
+		break;
+	case op_MAPI_ReadStream:
+		if (avail < 5) return false;
+		size += (ndr_fast_get_uint16(p + 3) == 0xBABE) ? 6 : 2;
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		if (avail < 5) return false;
+		size += (ndr_fast_get_uint16(p + 3) == 0xBABE) ? 4 : 2;
+		break;
+	default:
+		return false;
+	}
+	if (avail < size) return false;
+
+	if (p[0] == op_MAPI_GetProps) {
+		properties = talloc_array(ndr->current_mem_ctx, enum MAPITAGS, count);
+		if (!properties) return false;
+	}
+
+	r->opnum = p[0];
+	r->logon_id = p[1];
+	r->handle_idx = p[2];
+	p += 3;
+
+	switch (r->opnum) {
+	case op_MAPI_GetProps:
+		r->u.mapi_GetProps.PropertySizeLimit = ndr_fast_get_uint16(p);
+		r->u.mapi_GetProps.WantUnicode = ndr_fast_get_uint16(p + 2);
+		r->u.mapi_GetProps.prop_count = count;
+		for (i = 0; i < count; i++) {
+			properties[i] = (enum MAPITAGS) ndr_fast_get_uint32(p + 6 + i * 4);
+		}
+		r->u.mapi_GetProps.properties = properties;
+		break;
+	case op_MAPI_QueryRows:
+		r->u.mapi_QueryRows.QueryRowsFlags = (enum QueryRowsFlags) p[0];
+		r->u.mapi_QueryRows.ForwardRead = (enum ForwardRead) p[1];
+		r->u.mapi_QueryRows.RowCount = ndr_fast_get_uint16(p + 2);
+		break;
+	case op_MAPI_ReadStream:
+		r->u.mapi_ReadStream.ByteCount = ndr_fast_get_uint16(p);
+		if (r->u.mapi_ReadStream.ByteCount == 0xBABE) {
+			r->u.mapi_ReadStream.MaximumByteCount.value = ndr_fast_get_uint32(p + 2);
+		}
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		r->u.mapi_FastTransferSourceGetBuffer.BufferSize = ndr_fast_get_uint16(p);
+		if (r->u.mapi_FastTransferSourceGetBuffer.BufferSize == 0xBABE) {
+			r->u.mapi_FastTransferSourceGetBuffer.MaximumBufferSize.MaximumBufferSize = ndr_fast_get_uint16(p + 2);
+		}
+		break;
+	default:
+		break;
+	}
+	ndr->offset += size;
+
+	return true;
+}
+
+static bool ndr_push_EcDoRpc_MAPI_REPL_fast(struct ndr_push *ndr, const struct EcDoRpc_MAPI_REPL *r)
+{
+	const DATA_BLOB	*blob = NULL;
+	uint32_t	size = 6;
+	uint8_t		*p;
+
+	if (ndr->flags & LIBNDR_FLAG_BIGENDIAN) return false;
+	if (r->error_code != MAPI_E_SUCCESS) return false;
+
+	switch (r->opnum) {
+	case op_MAPI_Release:
+		/* Release replies are never sent */
+		return true;
+	case op_MAPI_GetProps:
+		blob = &r->u.mapi_GetProps.prop_data;
+		size += 1;
+		break;
+	case op_MAPI_QueryRows:
+		if (r->u.mapi_QueryRows.RowCount) {
+			blob = &r->u.mapi_QueryRows.RowData;
+		}
+		size += 3;
+		break;
+	case op_MAPI_ReadStream:
+		blob = &r->u.mapi_ReadStream.data;
+		if (blob->length > 0xFFFF) return false;
+		size += 2;
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		blob = &r->u.mapi_FastTransferSourceGetBuffer.TransferBuffer;
+		if (blob->length != r->u.mapi_FastTransferSourceGetBuffer.TransferBufferSize) return false;
+		size += 9;
+		break;
+	default:
+		return false;
+	}
+	if (blob && blob->length > UINT32_MAX - size) return false;
+
+	if (ndr_push_expand(ndr, size + (blob ? blob->length : 0)) != NDR_ERR_SUCCESS) return false;
+	p = ndr->data + ndr->offset;
+	p[0] = r->opnum;
+	p[1] = r->handle_idx;
+	ndr_fast_put_uint32(p + 2, r->error_code);
+	p += 6;
+
+	switch (r->opnum) {
+	case op_MAPI_GetProps:
+		p[0] = r->u.mapi_GetProps.layout;
+		break;
+	case op_MAPI_QueryRows:
+		p[0] = r->u.mapi_QueryRows.Origin;
+		ndr_fast_put_uint16(p + 1, r->u.mapi_QueryRows.RowCount);
+		break;
+	case op_MAPI_ReadStream:
+		ndr_fast_put_uint16(p, blob->length);
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		ndr_fast_put_uint16(p, r->u.mapi_FastTransferSourceGetBuffer.TransferStatus);
+		ndr_fast_put_uint16(p + 2, r->u.mapi_FastTransferSourceGetBuffer.InProgressCount);
+		ndr_fast_put_uint16(p + 4, r->u.mapi_FastTransferSourceGetBuffer.TotalStepCount);
+		p[6] = r->u.mapi_FastTransferSourceGetBuffer.Reserved;
+		ndr_fast_put_uint16(p + 7, r->u.mapi_FastTransferSourceGetBuffer.TransferBufferSize);
+		break;
+	default:
+		break;
+	}
+	if (blob && blob->length) {
+		memcpy(ndr->data + ndr->offset + size, blob->data, blob->length);
+		size += blob->length;
+	}
+	ndr->offset += size;
+
+	return true;
+}
+
+static bool ndr_pull_EcDoRpc_MAPI_REPL_fast(struct ndr_pull *ndr, struct EcDoRpc_MAPI_REPL *r)
+{
+	const uint8_t	*p;
+	uint32_t	avail;
+	uint32_t	size = 6;
+	uint32_t	length = 0;
+	DATA_BLOB	*blob = NULL;
+
+	if (ndr->flags & LIBNDR_FLAG_BIGENDIAN) return false;
+	if (ndr->offset >= ndr->data_size) return false;
+	avail = ndr->data_size - ndr->offset;
+	if (avail < size) return false;
+	p = ndr->data + ndr->offset;
+	if (ndr_fast_get_uint32(p + 2) != MAPI_E_SUCCESS) return false;
+
+	/* The data of GetProps and QueryRows replies takes the rest of
+	   the buffer */
+	switch (p[0]) {
+	case op_MAPI_Release:
+		break;
+	case op_MAPI_GetProps:
+		size += 1;
+		if (avail < size) return false;
+		length = avail - size;
+		break;
+	case op_MAPI_QueryRows:
+		size += 3;
+		if (avail < size) return false;
+		if (ndr_fast_get_uint16(p + 7)) {
+			length = avail - size;
+		}
+		break;
+	case op_MAPI_ReadStream:
+		size += 2;
+		if (avail < size) return false;
+		length = ndr_fast_get_uint16(p + 6);
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		size += 9;
+		if (avail < size) return false;
+		length = ndr_fast_get_uint16(p + 13);
+		break;
+	default:
+		return false;
+	}
+	if (avail - size < length) return false;
+
+	r->opnum = p[0];
+	r->handle_idx = p[1];
+	r->error_code = MAPI_E_SUCCESS;
+	p += 6;
+
+	switch (r->opnum) {
+	case op_MAPI_GetProps:
+		r->u.mapi_GetProps.layout = p[0];
+		blob = &r->u.mapi_GetProps.prop_data;
+		break;
+	case op_MAPI_QueryRows:
+		r->u.mapi_QueryRows.Origin = p[0];
+		r->u.mapi_QueryRows.RowCount = ndr_fast_get_uint16(p + 1);
+		blob = &r->u.mapi_QueryRows.RowData;
+		break;
+	case op_MAPI_ReadStream:
+		blob = &r->u.mapi_ReadStream.data;
+		break;
+	case op_MAPI_FastTransferSourceGetBuffer:
+		r->u.mapi_FastTransferSourceGetBuffer.TransferStatus = (enum TransferStatus) ndr_fast_get_uint16(p);
+		r->u.mapi_FastTransferSourceGetBuffer.InProgressCount = ndr_fast_get_uint16(p + 2);
+		r->u.mapi_FastTransferSourceGetBuffer.TotalStepCount = ndr_fast_get_uint16(p + 4);
+		r->u.mapi_FastTransferSourceGetBuffer.Reserved = p[6];
+		r->u.mapi_FastTransferSourceGetBuffer.TransferBufferSize = length;
+		blob = &r->u.mapi_FastTransferSourceGetBuffer.TransferBuffer;
+		break;
+	default:
+		break;
+	}
+	if (blob) {
+		*blob = data_blob_talloc(ndr->current_mem_ctx, ndr->data + ndr->offset + size, length);
+		if (length && !blob->data) return false;
+	}
+	ndr->offset += size + length;
+
+	return true;
+}
 
 /*
   push mapi_request / mapi_response onto the wire.
@@ -604,7 +997,9 @@ enum ndr_err_code ndr_push_mapi_request(struct ndr_push *ndr, int ndr_flags, con
 	NDR_CHECK(ndr_push_uint16(ndr, NDR_SCALARS, r->length));
 
 	for (count = 0; ndr->offset < r->length - 2; count++) {
-		NDR_CHECK(ndr_push_EcDoRpc_MAPI_REQ(ndr, NDR_SCALARS, &r->mapi_req[count]));
+		if (!ndr_push_EcDoRpc_MAPI_REQ_fast(ndr, &r->mapi_req[count])) {
+			NDR_CHECK(ndr_push_EcDoRpc_MAPI_REQ(ndr, NDR_SCALARS, &r->mapi_req[count]));
+		}
 	}
 
 	count = (r->mapi_len - r->length) / sizeof(uint32_t);
@@ -623,9 +1018,13 @@ enum ndr_err_code ndr_push_mapi_response(struct ndr_push *ndr, int ndr_flags, co
 	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
 	NDR_CHECK(ndr_push_uint16(ndr, NDR_SCALARS, r->length));
 
-	if (r->length > sizeof (uint16_t)) {
+	if (r->repl_data.length) {
+		NDR_CHECK(ndr_push_bytes(ndr, r->repl_data.data, r->repl_data.length));
+	} else if (r->length > sizeof (uint16_t)) {
 		for (count = 0; ndr->offset < r->length - 2; count++) {
-			NDR_CHECK(ndr_push_EcDoRpc_MAPI_REPL(ndr, NDR_SCALARS, &r->mapi_repl[count]));
+			if (!ndr_push_EcDoRpc_MAPI_REPL_fast(ndr, &r->mapi_repl[count])) {
+				NDR_CHECK(ndr_push_EcDoRpc_MAPI_REPL(ndr, NDR_SCALARS, &r->mapi_repl[count]));
+			}
 		}
 	}
 
@@ -645,6 +1044,7 @@ enum ndr_err_code ndr_pull_mapi_request(struct ndr_pull *ndr, int ndr_flags, str
 {
 	uint32_t length,count;
 	uint32_t cntr_mapi_req_0;
+	uint32_t size_mapi_req_0 = 8;
 	TALLOC_CTX *_mem_save_mapi_req_0;
 	TALLOC_CTX *_mem_save_handles_0;
 	struct ndr_pull *_ndr_mapi_req;
@@ -662,12 +1062,19 @@ enum ndr_err_code ndr_pull_mapi_request(struct ndr_pull *ndr, int ndr_flags, str
 	if (r->length > sizeof (uint16_t)) {
 		NDR_CHECK(ndr_pull_subcontext_start(ndr, &_ndr_mapi_req, 0, r->length - 2));
 		_mem_save_mapi_req_0 = NDR_PULL_GET_MEM_CTX(_ndr_mapi_req);
-		r->mapi_req = talloc_zero(_mem_save_mapi_req_0, struct EcDoRpc_MAPI_REQ);
+		r->mapi_req = talloc_zero_array(_mem_save_mapi_req_0, struct EcDoRpc_MAPI_REQ, size_mapi_req_0);
+		NDR_ERR_HAVE_NO_MEMORY(r->mapi_req);
 		for (cntr_mapi_req_0 = 0; _ndr_mapi_req->offset < _ndr_mapi_req->data_size - 2; cntr_mapi_req_0++) {
-			NDR_CHECK(ndr_pull_EcDoRpc_MAPI_REQ(_ndr_mapi_req, NDR_SCALARS, &r->mapi_req[cntr_mapi_req_0]));
-			r->mapi_req = talloc_realloc(_mem_save_mapi_req_0, r->mapi_req, struct EcDoRpc_MAPI_REQ, cntr_mapi_req_0 + 2);
+			/* Keep room for the terminating entry */
+			if (cntr_mapi_req_0 + 1 >= size_mapi_req_0) {
+				size_mapi_req_0 *= 2;
+				r->mapi_req = talloc_realloc(_mem_save_mapi_req_0, r->mapi_req, struct EcDoRpc_MAPI_REQ, size_mapi_req_0);
+				NDR_ERR_HAVE_NO_MEMORY(r->mapi_req);
+			}
+			if (!ndr_pull_EcDoRpc_MAPI_REQ_fast(_ndr_mapi_req, &r->mapi_req[cntr_mapi_req_0])) {
+				NDR_CHECK(ndr_pull_EcDoRpc_MAPI_REQ(_ndr_mapi_req, NDR_SCALARS, &r->mapi_req[cntr_mapi_req_0]));
+			}
 		}
-		r->mapi_req = talloc_realloc(_mem_save_mapi_req_0, r->mapi_req, struct EcDoRpc_MAPI_REQ, cntr_mapi_req_0 + 2);
 		r->mapi_req[cntr_mapi_req_0].opnum = 0;
 
 		if (_ndr_mapi_req->offset != r->length - 2) {
@@ -692,6 +1099,7 @@ enum ndr_err_code ndr_pull_mapi_response(struct ndr_pull *ndr, int ndr_flags, st
 {
 	uint32_t length,count;
 	uint32_t cntr_mapi_repl_0;
+	uint32_t size_mapi_repl_0 = 8;
 	TALLOC_CTX *_mem_save_mapi_repl_0;
 	TALLOC_CTX *_mem_save_handles_0;
 	struct ndr_pull *_ndr_mapi_repl;
@@ -702,17 +1110,26 @@ enum ndr_err_code ndr_pull_mapi_response(struct ndr_pull *ndr, int ndr_flags, st
 		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, &length));
 	}
 	r->mapi_len = length;
+	r->repl_data = data_blob_null;
 
 	NDR_CHECK(ndr_pull_uint16(ndr, NDR_SCALARS, &r->length));
 
 	/* If length equals length field then skipping subcontext */
 	if (r->length > sizeof (uint16_t)) {
 		_mem_save_mapi_repl_0 = NDR_PULL_GET_MEM_CTX(ndr);
-		r->mapi_repl = talloc_zero_array(_mem_save_mapi_repl_0, struct EcDoRpc_MAPI_REPL, 2);
+		r->mapi_repl = talloc_zero_array(_mem_save_mapi_repl_0, struct EcDoRpc_MAPI_REPL, size_mapi_repl_0);
+		NDR_ERR_HAVE_NO_MEMORY(r->mapi_repl);
 		NDR_CHECK(ndr_pull_subcontext_start(ndr, &_ndr_mapi_repl, 0, r->length - 2));
 		for (cntr_mapi_repl_0 = 0; _ndr_mapi_repl->offset < _ndr_mapi_repl->data_size - 2; cntr_mapi_repl_0++) {
-			NDR_CHECK(ndr_pull_EcDoRpc_MAPI_REPL(_ndr_mapi_repl, NDR_SCALARS, &r->mapi_repl[cntr_mapi_repl_0]));
-			r->mapi_repl = talloc_realloc(_ndr_mapi_repl, r->mapi_repl, struct EcDoRpc_MAPI_REPL, cntr_mapi_repl_0 + 2);
+			/* Keep room for the terminating entry */
+			if (cntr_mapi_repl_0 + 1 >= size_mapi_repl_0) {
+				size_mapi_repl_0 *= 2;
+				r->mapi_repl = talloc_realloc(_mem_save_mapi_repl_0, r->mapi_repl, struct EcDoRpc_MAPI_REPL, size_mapi_repl_0);
+				NDR_ERR_HAVE_NO_MEMORY(r->mapi_repl);
+			}
+			if (!ndr_pull_EcDoRpc_MAPI_REPL_fast(_ndr_mapi_repl, &r->mapi_repl[cntr_mapi_repl_0])) {
+				NDR_CHECK(ndr_pull_EcDoRpc_MAPI_REPL(_ndr_mapi_repl, NDR_SCALARS, &r->mapi_repl[cntr_mapi_repl_0]));
+			}
 		}
 		r->mapi_repl[cntr_mapi_repl_0].opnum = 0;
 		NDR_CHECK(ndr_pull_subcontext_end(ndr, _ndr_mapi_repl, 4, -1));
@@ -746,7 +1163,7 @@ _PUBLIC_ enum ndr_err_code ndr_push_EcDoRpc_MAPI_REPL(struct ndr_push *ndr, int
 		if (ndr_flags & NDR_SCALARS) {
 			NDR_CHECK(ndr_push_align(ndr, 8));
 			NDR_CHECK(ndr_push_uint8(ndr, NDR_SCALARS, r->opnum));
-			if ((r->opnum == op_MAPI_Notify) || (r->opnum == op_MAPI_Pending)) {
+			if ((r->opnum == op_MAPI_Notify) || (r->opnum == op_MAPI_Pending) || (r->opnum == op_MAPI_Backoff)) {
 				NDR_CHECK(ndr_push_set_switch_value(ndr, &r->u, r->opnum));
 				NDR_CHECK(ndr_push_EcDoRpc_MAPI_REPL_UNION(ndr, NDR_SCALARS, &r->u));
 			} else {
@@ -762,6 +1179,12 @@ _PUBLIC_ enum ndr_err_code ndr_push_EcDoRpc_MAPI_REPL(struct ndr_push *ndr, int
 							NDR_CHECK(ndr_push_Logon_redirect(ndr, NDR_SCALARS, &(r->us.mapi_Logon)));
 						}
 						break; }
+					case op_MAPI_FastTransferSourceGetBuffer: {
+						/* ecServerBusy is followed by the time the client should wait */
+						if (r->error_code == ecServerBusy) {
+							NDR_CHECK(ndr_push_FastTransferSourceGetBuffer_busy(ndr, NDR_SCALARS, &(r->us.mapi_FastTransferSourceGetBuffer)));
+						}
+						break; }
 					case op_MAPI_GetIDsFromNames: {
 						/* MAPI_W_ERRORS_RETURNED still enables the final array to be passed */
 						if (r->error_code == MAPI_W_ERRORS_RETURNED) {
@@ -799,7 +1222,7 @@ enum ndr_err_code ndr_pull_EcDoRpc_MAPI_REPL(struct ndr_pull *ndr, int ndr_flags
 		if (ndr_flags & NDR_SCALARS) {
 			NDR_CHECK(ndr_pull_align(ndr, 8));
 			NDR_CHECK(ndr_pull_uint8(ndr, NDR_SCALARS, &r->opnum));
-			if ((r->opnum == op_MAPI_Notify) || (r->opnum == op_MAPI_Pending)) {
+			if ((r->opnum == op_MAPI_Notify) || (r->opnum == op_MAPI_Pending) || (r->opnum == op_MAPI_Backoff)) {
 				NDR_CHECK(ndr_pull_set_switch_value(ndr, &r->u, r->opnum));
 				NDR_CHECK(ndr_pull_EcDoRpc_MAPI_REPL_UNION(ndr, NDR_SCALARS, &r->u));
 			} else {
@@ -821,6 +1244,12 @@ enum ndr_err_code ndr_pull_EcDoRpc_MAPI_REPL(struct ndr_pull *ndr, int ndr_flags
 							NDR_CHECK(ndr_pull_Logon_redirect(ndr, NDR_SCALARS, &(r->us.mapi_Logon)));
 						}
 						break;}
+					case op_MAPI_FastTransferSourceGetBuffer: {
+						/* ecServerBusy is followed by the time the client should wait */
+						if (r->error_code == ecServerBusy) {
+							NDR_CHECK(ndr_pull_FastTransferSourceGetBuffer_busy(ndr, NDR_SCALARS, &(r->us.mapi_FastTransferSourceGetBuffer)));
+						}
+						break;}
 					case op_MAPI_GetIDsFromNames: {
 						/* MAPI_W_ERRORS_RETURNED still enables the final array to be passed */
 						if (r->error_code == MAPI_W_ERRORS_RETURNED) {
@@ -871,7 +1300,7 @@ void ndr_print_EcDoRpc_MAPI_REPL(struct ndr_print *ndr, const char *name, const
 		ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
 		ndr->depth++;
 		ndr_print_uint8(ndr, "opnum", r->opnum);
-		if ((r->opnum != op_MAPI_Notify) && (r->opnum != op_MAPI_Pending)) {
+		if ((r->opnum != op_MAPI_Notify) && (r->opnum != op_MAPI_Pending) && (r->opnum != op_MAPI_Backoff)) {
 			ndr_print_uint8(ndr, "handle_idx", r->handle_idx);
 			ndr_print_MAPISTATUS(ndr, "error_code", r->error_code);
 			if (r->error_code == MAPI_E_SUCCESS) {
@@ -885,6 +1314,12 @@ void ndr_print_EcDoRpc_MAPI_REPL(struct ndr_print *ndr, const char *name, const
 						ndr_print_EcDoRpc_MAPI_REPL_UNION_SPECIAL(ndr, "us", &r->us);
 					}
 					break;}
+				case op_MAPI_FastTransferSourceGetBuffer: {
+					if (r->error_code == ecServerBusy) {
+						ndr_print_set_switch_value(ndr, &r->us, r->opnum);
+						ndr_print_EcDoRpc_MAPI_REPL_UNION_SPECIAL(ndr, "us", &r->us);
+					}
+					break;}
 				case op_MAPI_GetIDsFromNames: {
 					/* MAPI_W_ERRORS_RETURNED still enables the final array to be passed */
 					if (r->error_code == MAPI_W_ERRORS_RETURNED) {
@@ -1694,6 +2129,167 @@ _PUBLIC_ void ndr_print_EcDoRpcExt(struct ndr_print *ndr, const char *name, int
 	talloc_free(mem_ctx);
 }
 
+/**
+   \details Pull an EcDoRpcExt2 call
+
+   Unlike the generated code, rgbIn and rgbAuxIn are views into the
+   stub buffer rather than copies, and the output arrays are not
+   preallocated to the size the client accepts: the server allocates
+   them when the response is built. The views remain valid as long as
+   the buffer being pulled, which the DCE/RPC call owns.
+ */
+_PUBLIC_ enum ndr_err_code ndr_pull_EcDoRpcExt2(struct ndr_pull *ndr, int flags, struct EcDoRpcExt2 *r)
+{
+	TALLOC_CTX	*_mem_save_handle_0;
+	TALLOC_CTX	*_mem_save_pulFlags_0;
+	TALLOC_CTX	*_mem_save_pcbOut_0;
+	TALLOC_CTX	*_mem_save_pcbAuxOut_0;
+	TALLOC_CTX	*_mem_save_pulTransTime_0;
+	uint32_t	size;
+
+	if (flags & NDR_IN) {
+		ZERO_STRUCT(r->out);
+
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->in.handle);
+		}
+		_mem_save_handle_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->in.handle, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_policy_handle(ndr, NDR_SCALARS, r->in.handle));
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_handle_0, LIBNDR_FLAG_REF_ALLOC);
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->in.pulFlags);
+		}
+		_mem_save_pulFlags_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->in.pulFlags, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->in.pulFlags));
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pulFlags_0, LIBNDR_FLAG_REF_ALLOC);
+
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, &size));
+		NDR_PULL_NEED_BYTES(ndr, size);
+		r->in.rgbIn = ndr->data + ndr->offset;
+		ndr->offset += size;
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, &r->in.cbIn));
+		if (r->in.cbIn != size) {
+			return ndr_pull_error(ndr, NDR_ERR_ARRAY_SIZE, "Bad array size %u should be %u", size, r->in.cbIn);
+		}
+
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->in.pcbOut);
+		}
+		_mem_save_pcbOut_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->in.pcbOut, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->in.pcbOut));
+		if (*r->in.pcbOut > 0x40000) {
+			return ndr_pull_error(ndr, NDR_ERR_RANGE, "[in] pcbOut value out of range: 0x%x\n", *r->in.pcbOut);
+		}
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pcbOut_0, LIBNDR_FLAG_REF_ALLOC);
+
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, &size));
+		NDR_PULL_NEED_BYTES(ndr, size);
+		r->in.rgbAuxIn = ndr->data + ndr->offset;
+		ndr->offset += size;
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, &r->in.cbAuxIn));
+		if (r->in.cbAuxIn != size) {
+			return ndr_pull_error(ndr, NDR_ERR_ARRAY_SIZE, "Bad array size %u should be %u", size, r->in.cbAuxIn);
+		}
+
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->in.pcbAuxOut);
+		}
+		_mem_save_pcbAuxOut_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->in.pcbAuxOut, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->in.pcbAuxOut));
+		if (*r->in.pcbAuxOut > 0x1008) {
+			return ndr_pull_error(ndr, NDR_ERR_RANGE, "[in] pcbAuxOut value out of range: 0x%x\n", *r->in.pcbAuxOut);
+		}
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pcbAuxOut_0, LIBNDR_FLAG_REF_ALLOC);
+
+		NDR_PULL_ALLOC(ndr, r->out.handle);
+		*r->out.handle = *r->in.handle;
+		NDR_PULL_ALLOC(ndr, r->out.pulFlags);
+		*r->out.pulFlags = *r->in.pulFlags;
+		NDR_PULL_ALLOC(ndr, r->out.pcbOut);
+		*r->out.pcbOut = *r->in.pcbOut;
+		NDR_PULL_ALLOC(ndr, r->out.pcbAuxOut);
+		*r->out.pcbAuxOut = *r->in.pcbAuxOut;
+		NDR_PULL_ALLOC(ndr, r->out.pulTransTime);
+		ZERO_STRUCTP(r->out.pulTransTime);
+	}
+
+	if (flags & NDR_OUT) {
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->out.handle);
+		}
+		_mem_save_handle_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->out.handle, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_policy_handle(ndr, NDR_SCALARS, r->out.handle));
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_handle_0, LIBNDR_FLAG_REF_ALLOC);
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->out.pulFlags);
+		}
+		_mem_save_pulFlags_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->out.pulFlags, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->out.pulFlags));
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pulFlags_0, LIBNDR_FLAG_REF_ALLOC);
+
+		/* Output arrays are only allocated here when the request
+		   was not pulled with this function */
+		NDR_CHECK(ndr_pull_array_size(ndr, &r->out.rgbOut));
+		NDR_CHECK(ndr_pull_array_length(ndr, &r->out.rgbOut));
+		if (ndr_get_array_length(ndr, &r->out.rgbOut) > ndr_get_array_size(ndr, &r->out.rgbOut)) {
+			return ndr_pull_error(ndr, NDR_ERR_ARRAY_SIZE, "Bad array size %u should exceed array length %u", ndr_get_array_size(ndr, &r->out.rgbOut), ndr_get_array_length(ndr, &r->out.rgbOut));
+		}
+		if ((ndr->flags & LIBNDR_FLAG_REF_ALLOC) || !r->out.rgbOut) {
+			NDR_PULL_ALLOC_N(ndr, r->out.rgbOut, ndr_get_array_size(ndr, &r->out.rgbOut));
+		}
+		NDR_CHECK(ndr_pull_array_uint8(ndr, NDR_SCALARS, r->out.rgbOut, ndr_get_array_length(ndr, &r->out.rgbOut)));
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->out.pcbOut);
+		}
+		_mem_save_pcbOut_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->out.pcbOut, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->out.pcbOut));
+		if (*r->out.pcbOut > 0x40000) {
+			return ndr_pull_error(ndr, NDR_ERR_RANGE, "[out] pcbOut value out of range: 0x%x\n", *r->out.pcbOut);
+		}
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pcbOut_0, LIBNDR_FLAG_REF_ALLOC);
+
+		NDR_CHECK(ndr_pull_array_size(ndr, &r->out.rgbAuxOut));
+		NDR_CHECK(ndr_pull_array_length(ndr, &r->out.rgbAuxOut));
+		if (ndr_get_array_length(ndr, &r->out.rgbAuxOut) > ndr_get_array_size(ndr, &r->out.rgbAuxOut)) {
+			return ndr_pull_error(ndr, NDR_ERR_ARRAY_SIZE, "Bad array size %u should exceed array length %u", ndr_get_array_size(ndr, &r->out.rgbAuxOut), ndr_get_array_length(ndr, &r->out.rgbAuxOut));
+		}
+		if ((ndr->flags & LIBNDR_FLAG_REF_ALLOC) || !r->out.rgbAuxOut) {
+			NDR_PULL_ALLOC_N(ndr, r->out.rgbAuxOut, ndr_get_array_size(ndr, &r->out.rgbAuxOut));
+		}
+		NDR_CHECK(ndr_pull_array_uint8(ndr, NDR_SCALARS, r->out.rgbAuxOut, ndr_get_array_length(ndr, &r->out.rgbAuxOut)));
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->out.pcbAuxOut);
+		}
+		_mem_save_pcbAuxOut_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->out.pcbAuxOut, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->out.pcbAuxOut));
+		if (*r->out.pcbAuxOut > 0x1008) {
+			return ndr_pull_error(ndr, NDR_ERR_RANGE, "[out] pcbAuxOut value out of range: 0x%x\n", *r->out.pcbAuxOut);
+		}
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pcbAuxOut_0, LIBNDR_FLAG_REF_ALLOC);
+		if (ndr->flags & LIBNDR_FLAG_REF_ALLOC) {
+			NDR_PULL_ALLOC(ndr, r->out.pulTransTime);
+		}
+		_mem_save_pulTransTime_0 = NDR_PULL_GET_MEM_CTX(ndr);
+		NDR_PULL_SET_MEM_CTX(ndr, r->out.pulTransTime, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_uint32(ndr, NDR_SCALARS, r->out.pulTransTime));
+		NDR_PULL_SET_MEM_CTX(ndr, _mem_save_pulTransTime_0, LIBNDR_FLAG_REF_ALLOC);
+		NDR_CHECK(ndr_pull_MAPISTATUS(ndr, NDR_SCALARS, &r->out.result));
+		NDR_CHECK(ndr_check_array_size(ndr, (void *)&r->out.rgbOut, *r->out.pcbOut));
+		NDR_CHECK(ndr_check_array_length(ndr, (void *)&r->out.rgbOut, *r->out.pcbOut));
+		NDR_CHECK(ndr_check_array_size(ndr, (void *)&r->out.rgbAuxOut, *r->out.pcbAuxOut));
+		NDR_CHECK(ndr_check_array_length(ndr, (void *)&r->out.rgbAuxOut, *r->out.pcbAuxOut));
+	}
+	return NDR_ERR_SUCCESS;
+}
+
 _PUBLIC_ void ndr_print_EcDoRpcExt2(struct ndr_print *ndr, const char *name, int flags, const struct EcDoRpcExt2 *r)
 {
 	uint32_t		cntr_rgbAuxOut_0;
@@ -2492,33 +3088,90 @@ enum ndr_err_code ndr_pull_Backoff_req(struct ndr_pull *ndr, int ndr_flags, stru
 	return NDR_ERR_SUCCESS;
 }
 
-enum ndr_err_code ndr_push_Backoff_repl(struct ndr_push *ndr, int ndr_flags, const struct Backoff_repl *r)
+enum ndr_err_code ndr_push_BufferTooSmall_req(struct ndr_push *ndr, int ndr_flags, const struct BufferTooSmall_req *r)
 {
 	return NDR_ERR_SUCCESS;
 }
 
-enum ndr_err_code ndr_pull_Backoff_repl(struct ndr_pull *ndr, int ndr_flags, struct Backoff_repl *r)
+enum ndr_err_code ndr_pull_BufferTooSmall_req(struct ndr_pull *ndr, int ndr_flags, struct BufferTooSmall_req *r)
 {
 	return NDR_ERR_SUCCESS;
 }
 
-enum ndr_err_code ndr_push_BufferTooSmall_req(struct ndr_push *ndr, int ndr_flags, const struct BufferTooSmall_req *r)
+enum ndr_err_code ndr_push_BufferTooSmall_repl(struct ndr_push *ndr, int ndr_flags, const struct BufferTooSmall_repl *r)
 {
 	return NDR_ERR_SUCCESS;
 }
 
-enum ndr_err_code ndr_pull_BufferTooSmall_req(struct ndr_pull *ndr, int ndr_flags, struct BufferTooSmall_req *r)
+enum ndr_err_code ndr_pull_BufferTooSmall_repl(struct ndr_pull *ndr, int ndr_flags, struct BufferTooSmall_repl *r)
 {
 	return NDR_ERR_SUCCESS;
 }
 
-enum ndr_err_code ndr_push_BufferTooSmall_repl(struct ndr_push *ndr, int ndr_flags, const struct BufferTooSmall_repl *r)
+/**
+   \details Pull a blob as a view into the buffer being pulled
+
+   Stream and FastTransfer payloads are not copied: the returned blob
+   points into the ndr_pull data and remains valid as long as the
+   buffer it was pulled from.
+
+   \param ndr pointer to the ndr_pull structure
+   \param blob pointer to the blob to fill
+   \param length number of bytes of the blob
+
+   \return NDR_ERR_SUCCESS on success, otherwise NDR error
+ */
+static enum ndr_err_code ndr_pull_DATA_BLOB_view(struct ndr_pull *ndr, DATA_BLOB *blob, uint32_t length)
 {
+	NDR_PULL_NEED_BYTES(ndr, length);
+	blob->data = length ? ndr->data + ndr->offset : NULL;
+	blob->length = length;
+	ndr->offset += length;
+
 	return NDR_ERR_SUCCESS;
 }
 
-enum ndr_err_code ndr_pull_BufferTooSmall_repl(struct ndr_pull *ndr, int ndr_flags, struct BufferTooSmall_repl *r)
+enum ndr_err_code ndr_pull_WriteStream_req(struct ndr_pull *ndr, int ndr_flags, struct WriteStream_req *r)
+{
+	uint32_t	_flags_save_STRUCT = ndr->flags;
+	uint16_t	size;
+
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	if (ndr_flags & NDR_SCALARS) {
+		NDR_CHECK(ndr_pull_uint16(ndr, NDR_SCALARS, &size));
+		NDR_CHECK(ndr_pull_DATA_BLOB_view(ndr, &r->data, size));
+	}
+	ndr->flags = _flags_save_STRUCT;
+
+	return NDR_ERR_SUCCESS;
+}
+
+enum ndr_err_code ndr_pull_WriteAndCommitStream_req(struct ndr_pull *ndr, int ndr_flags, struct WriteAndCommitStream_req *r)
+{
+	uint32_t	_flags_save_STRUCT = ndr->flags;
+	uint16_t	size;
+
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	if (ndr_flags & NDR_SCALARS) {
+		NDR_CHECK(ndr_pull_uint16(ndr, NDR_SCALARS, &size));
+		NDR_CHECK(ndr_pull_DATA_BLOB_view(ndr, &r->data, size));
+	}
+	ndr->flags = _flags_save_STRUCT;
+
+	return NDR_ERR_SUCCESS;
+}
+
+enum ndr_err_code ndr_pull_FastTransferDestinationPutBuffer_req(struct ndr_pull *ndr, int ndr_flags, struct FastTransferDestinationPutBuffer_req *r)
 {
+	uint32_t	_flags_save_STRUCT = ndr->flags;
+
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	if (ndr_flags & NDR_SCALARS) {
+		NDR_CHECK(ndr_pull_uint16(ndr, NDR_SCALARS, &r->TransferBufferSize));
+		NDR_CHECK(ndr_pull_DATA_BLOB_view(ndr, &r->TransferBuffer, r->TransferBufferSize));
+	}
+	ndr->flags = _flags_save_STRUCT;
+
 	return NDR_ERR_SUCCESS;
 }
 
@@ -84,5 +84,22 @@ foreach ($remainingSummary as $msg) {
 	unset($msg);
 }
 
+$table3 = $contacts->getMessageTable(PidTagDisplayName);
+ok($table3, "Contacts getMessageTable with property PidTagDisplayName");
+$table3->sort(PidTagDisplayName, MAPITable::SORT_ASCEND);
+
+$firstPage = $table3->summary(2, 0);
+is(count($firstPage), 2, "Get the first page of the sorted summaries");
+ok(strcmp($firstPage[0][PidTagDisplayName], $firstPage[1][PidTagDisplayName]) <= 0, "Check the summaries are sorted");
+
+$page = $table3->getMessages(1, 1);
+is(count($page), 1, "Get one message at offset 1");
+is($page[0]->get(PidTagDisplayName), $firstPage[1][PidTagDisplayName], "Check the message at offset 1 is the second one");
+unset($page);
+
+$table3->restrict(PidTagDisplayName, MAPITable::RELOP_EQ, $firstPage[0][PidTagDisplayName]);
+ok($table3->count() >= 1, "Restrict the table to the first display name");
+unset($firstPage);
+
 endTestSuite("message-table.php");
 ?>
@@ -53,7 +53,6 @@ zval *create_appointment_object(zval *folder, mapi_object_t *message, char open_
 	struct SPropTagArray	*SPropTagArray;
 
 	appointment =  create_message_object("mapiappointment", folder, message, open_mode TSRMLS_CC);
-	mapi_message_request_all_properties(appointment TSRMLS_CC);
 
 	return appointment;
 }
@@ -365,7 +364,7 @@ PHP_METHOD(MAPIAppointment, setRecurrence)
 	mem_ctx = message_obj->talloc_ctx;
 
 	bin_pattern = set_AppointmentRecurrencePattern(mem_ctx, &recurrence);
-	mapi_message_so_set_prop(mem_ctx, message_obj->message, id, (void*) bin_pattern TSRMLS_CC);
+	mapi_message_so_set_prop(mem_ctx, mapi_message_get_object(message_obj TSRMLS_CC), id, (void*) bin_pattern TSRMLS_CC);
 }
 
 PHP_METHOD(MAPIAppointment, getRecurrence)
@@ -379,6 +378,7 @@ PHP_METHOD(MAPIAppointment, getRecurrence)
 	message_obj = (mapi_message_object_t *) zend_object_store_get_object(getThis() TSRMLS_CC);
 	mem_ctx = message_obj->talloc_ctx;
 
+	mapi_message_request_all_properties(message_obj TSRMLS_CC);
 	bin_pattern = (struct Binary_r*) find_mapi_SPropValue_data(&(message_obj->properties), id);
 	recurrence = get_AppointmentRecurrencePattern(mem_ctx, bin_pattern);
 
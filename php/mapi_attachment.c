@@ -50,7 +50,6 @@ zval *create_attachment_object(zval *message, mapi_object_t *attachment TSRMLS_D
 
 	parent = (mapi_message_object_t *) zend_object_store_get_object(message TSRMLS_CC);
 	z_attachment = create_message_object("mapiattachment", message, attachment, parent->open_mode TSRMLS_CC);
-	mapi_message_request_all_properties(z_attachment TSRMLS_CC);
 	return z_attachment;
 }
 
@@ -83,7 +82,7 @@ PHP_METHOD(MAPIAttachment, save)
 	z_parent = this_obj->parent;
 	parent = (mapi_message_object_t *) zend_object_store_get_object(z_parent TSRMLS_CC);
 
-	res = SaveChangesAttachment(parent->message, this_obj->message, KeepOpenReadWrite);
+	res = SaveChangesAttachment(mapi_message_get_object(parent TSRMLS_CC), this_obj->message, KeepOpenReadWrite);
 	CHECK_MAPI_RETVAL(res, "SaveChangesAttachment");
 }
 
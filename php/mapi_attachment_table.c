@@ -101,7 +101,7 @@ PHP_METHOD(MAPIAttachmentTable, getAttachments)
 	MAKE_STD_ZVAL(res);
 	array_init(res);
 
-	while (mapi_table_next_row_set(this_obj->table, &row_set, count TSRMLS_CC)) {
+	while (mapi_table_next_row_set(this_obj, &row_set, count TSRMLS_CC)) {
 		for (i = 0; i < row_set.cRows; i++) {
 			attach_num = (const uint32_t *)find_SPropValue_data(&(row_set.aRow[i]), PR_ATTACH_NUM);
 			attachment = mapi_message_get_attachment(message, *attach_num TSRMLS_CC);
@@ -309,6 +309,7 @@ zval* mapi_folder_open_message(zval *folder, mapi_id_t message_id, char open_mod
 {
 	zval *php_message;
 	mapi_folder_object_t *this_obj;
+	mapi_message_object_t *message_obj;
 	mapi_object_t *message;
 	enum MAPISTATUS		retval;
 
@@ -337,6 +338,38 @@ zval* mapi_folder_open_message(zval *folder, mapi_id_t message_id, char open_mod
 	default:
 		php_error(E_ERROR, "Unknow folder type: %i", this_obj->type);
 	}
+	message_obj = STORE_OBJECT(mapi_message_object_t*, php_message);
+	message_obj->mid = message_id;
+
+	return php_message;
+}
+
+/* The message is opened on first use; the columns of its row are
+   available before that */
+zval* mapi_folder_listed_message(zval *folder, struct SRow *row, char open_mode TSRMLS_DC)
+{
+	zval			*php_message;
+	mapi_folder_object_t	*this_obj;
+	mapi_message_object_t	*message_obj;
+
+	this_obj = (mapi_folder_object_t *) zend_object_store_get_object(folder TSRMLS_CC);
+	switch(this_obj->type) {
+	case CONTACT:
+		php_message = create_contact_object(folder, NULL, open_mode TSRMLS_CC);
+		break;
+	case TASK:
+		php_message = create_task_object(folder, NULL, open_mode TSRMLS_CC);
+		break;
+	case APPOINTMENT:
+		php_message = create_appointment_object(folder, NULL, open_mode TSRMLS_CC);
+		break;
+	default:
+		php_error(E_ERROR, "Unknow folder type: %i", this_obj->type);
+	}
+
+	message_obj = STORE_OBJECT(mapi_message_object_t*, php_message);
+	message_obj->mid = row->lpProps[0].value.d;
+	mapi_message_prefill_properties(message_obj, row);
 
 	return php_message;
 }
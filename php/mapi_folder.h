@@ -67,6 +67,7 @@ PHP_METHOD(MAPIFolder, deleteMessages);
 void MAPIFolderRegisterClass(TSRMLS_D);
 zval *create_folder_object(zval *php_mailbox, mapi_id_t id, mapi_folder_type_t type TSRMLS_DC);
 zval* mapi_folder_open_message(zval *folder, mapi_id_t message_id, char open_mode TSRMLS_DC);
+zval* mapi_folder_listed_message(zval *folder, struct SRow *row, char open_mode TSRMLS_DC);
 mapi_folder_type_t mapi_folder_type_from_string(char *folder_type_str);
 
 
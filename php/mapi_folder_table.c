@@ -88,17 +88,22 @@ PHP_METHOD(MAPIFolderTable, summary)
 	struct mapi_SPropValue_array	properties_array;
 
 	long countParam = -1;
+	long offsetParam = -1;
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-			       "|l", &countParam) == FAILURE) {
+			       "|ll", &countParam, &offsetParam) == FAILURE) {
 		RETURN_NULL();
 	}
 
 	count = (countParam > 0) ? (uint32_t) countParam : 50;
 	this_obj = (mapi_table_object_t*)  zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (offsetParam >= 0) {
+		mapi_table_seek(this_obj, (uint32_t) offsetParam TSRMLS_CC);
+	}
+
 	MAKE_STD_ZVAL(summary);
 	array_init(summary);
-	while (mapi_table_next_row_set(this_obj->table, &row_set, count TSRMLS_CC)) {
+	while (mapi_table_next_row_set(this_obj, &row_set, count TSRMLS_CC)) {
 		for (i = 0; i < row_set.cRows; i++) {
 			zval *obj_summary;
 			MAKE_STD_ZVAL(obj_summary);
@@ -143,8 +148,9 @@ PHP_METHOD(MAPIFolderTable, getFolders)
 	uint32_t		i;
 
 	long countParam = -1;
+	long offsetParam = -1;
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-			       "|l", &countParam) == FAILURE) {
+			       "|ll", &countParam, &offsetParam) == FAILURE) {
 		RETURN_NULL();
 	}
 
@@ -154,10 +160,14 @@ PHP_METHOD(MAPIFolderTable, getFolders)
 	folder_obj = (mapi_folder_object_t*) zend_object_store_get_object(folder TSRMLS_CC);
 	mailbox = folder_obj->parent;
 
+	if (offsetParam >= 0) {
+		mapi_table_seek(this_obj, (uint32_t) offsetParam TSRMLS_CC);
+	}
+
 	MAKE_STD_ZVAL(res);
 	array_init(res);
 
-	while (mapi_table_next_row_set(this_obj->table, &row_set, count TSRMLS_CC)) {
+	while (mapi_table_next_row_set(this_obj, &row_set, count TSRMLS_CC)) {
 		for (i = 0; i < row_set.cRows; i++) {
 			zval			*folder;
 			mapi_id_t    		folder_id;
@@ -99,25 +99,76 @@ void MAPIMessageRegisterClass(TSRMLS_D)
 
 }
 
-void mapi_message_request_all_properties(zval *z_message TSRMLS_DC)
+/* Messages listed from a table are only opened on the server when
+   something else than the listed columns is needed */
+mapi_object_t *mapi_message_get_object(mapi_message_object_t *obj TSRMLS_DC)
 {
 	enum MAPISTATUS		retval;
-	mapi_message_object_t 	*obj;
+	mapi_folder_object_t	*folder_obj;
+	mapi_object_t		*message;
 
-	obj = (mapi_message_object_t *) zend_object_store_get_object(z_message TSRMLS_CC);
-	retval = GetPropsAll(obj->message, MAPI_UNICODE, &(obj->properties));
+	if (obj->message) {
+		return obj->message;
+	}
+
+	folder_obj = (mapi_folder_object_t *) zend_object_store_get_object(obj->parent TSRMLS_CC);
+	message = (mapi_object_t*) emalloc(sizeof(mapi_object_t));
+	mapi_object_init(message);
+
+	retval = OpenMessage(&(folder_obj->store), folder_obj->store.id, obj->mid, message, obj->open_mode);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_object_release(message);
+		efree(message);
+	}
+	CHECK_MAPI_RETVAL(retval, "Open message");
+	obj->message = message;
+
+	return obj->message;
+}
+
+void mapi_message_request_all_properties(mapi_message_object_t *obj TSRMLS_DC)
+{
+	enum MAPISTATUS		retval;
+	mapi_object_t		*message;
+
+	if (obj->properties_loaded) {
+		return;
+	}
+
+	message = mapi_message_get_object(obj TSRMLS_CC);
+	retval = GetPropsAll(message, MAPI_UNICODE, &(obj->properties));
         CHECK_MAPI_RETVAL(retval, "Getting message properties");
-	mapi_SPropValue_array_named(obj->message,  &(obj->properties));
+	mapi_SPropValue_array_named(message,  &(obj->properties));
+	obj->properties_loaded = true;
+}
+
+void mapi_message_prefill_properties(mapi_message_object_t *obj, struct SRow *row)
+{
+	uint32_t	i;
+
+	/* the values are not copied, keep the row alive */
+	talloc_reference(obj->talloc_ctx, row->lpProps);
+	obj->properties.cValues = 0;
+	obj->properties.lpProps = talloc_array(obj->talloc_ctx, struct mapi_SPropValue, row->cValues);
+	for (i = 0; i < row->cValues; i++) {
+		if ((row->lpProps[i].ulPropTag & 0xFFFF) == PT_ERROR) {
+			continue;
+		}
+		cast_mapi_SPropValue(obj->talloc_ctx, &(obj->properties.lpProps[obj->properties.cValues]), &(row->lpProps[i]));
+		obj->properties.cValues++;
+	}
 }
 
 void mapi_message_so_request_properties(mapi_message_object_t *obj, struct SPropTagArray *SPropTagArray TSRMLS_DC)
 {
 	enum MAPISTATUS		retval;
 	struct SPropValue 	*lpProps;
+	mapi_object_t		*message;
 	int			i;
 	int			count;
 
-	retval = GetProps(obj->message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
+	message = mapi_message_get_object(obj TSRMLS_CC);
+	retval = GetProps(message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
         CHECK_MAPI_RETVAL(retval, "Getting appointment properties");
 
 	obj->properties.cValues = count;
@@ -127,7 +178,7 @@ void mapi_message_so_request_properties(mapi_message_object_t *obj, struct SProp
 	}
 	MAPIFreeBuffer(lpProps);
 
-	mapi_SPropValue_array_named(obj->message,  &(obj->properties));
+	mapi_SPropValue_array_named(message,  &(obj->properties));
 }
 
 zval *create_message_object(char *class, zval *folder, mapi_object_t *message, char open_mode TSRMLS_DC)
@@ -183,8 +234,12 @@ mapi_id_t mapi_message_get_id(zval *message TSRMLS_DC)
 	mapi_id_t		*mid;
 	mapi_message_object_t *msg_obj = STORE_OBJECT(mapi_message_object_t*, message);
 
+	if (msg_obj->mid) {
+		return msg_obj->mid;
+	}
+
 	SPropTagArray = set_SPropTagArray(msg_obj->talloc_ctx, 0x1, PR_MID);
-	GetProps(msg_obj->message, 0, SPropTagArray, &lpProps, &count);
+	GetProps(mapi_message_get_object(msg_obj TSRMLS_CC), 0, SPropTagArray, &lpProps, &count);
 	MAPIFreeBuffer(SPropTagArray);
 	CHECK_MAPI_RETVAL(GetLastError(), "getID");
 
@@ -192,17 +247,21 @@ mapi_id_t mapi_message_get_id(zval *message TSRMLS_DC)
 	return *mid;
 }
 
-zval* mapi_message_get_property(mapi_message_object_t* msg, mapi_id_t prop_id)
+zval* mapi_message_get_property(mapi_message_object_t* msg, mapi_id_t prop_id TSRMLS_DC)
 {
 	zval *zprop;
 	void *prop_value;
 	prop_value  = (void*) find_mapi_SPropValue_data(&(msg->properties), prop_id);
+	if ((prop_value == NULL) && !msg->properties_loaded) {
+		mapi_message_request_all_properties(msg TSRMLS_CC);
+		prop_value  = (void*) find_mapi_SPropValue_data(&(msg->properties), prop_id);
+	}
 	zprop = mapi_message_property_to_zval(msg->talloc_ctx, prop_id, prop_value);
 
 	return zprop;
 }
 
-zval* mapi_message_get_base64_binary_property(mapi_message_object_t* msg, mapi_id_t prop_id)
+zval* mapi_message_get_base64_binary_property(mapi_message_object_t* msg, mapi_id_t prop_id TSRMLS_DC)
 {
 	zval 		*result;
 	uint32_t 	prop_type;
@@ -216,6 +275,10 @@ zval* mapi_message_get_base64_binary_property(mapi_message_object_t* msg, mapi_i
 	}
 
 	bin  = (struct Binary_r*) find_mapi_SPropValue_data(&(msg->properties), prop_id);
+	if ((bin == NULL) && !msg->properties_loaded) {
+		mapi_message_request_all_properties(msg TSRMLS_CC);
+		bin  = (struct Binary_r*) find_mapi_SPropValue_data(&(msg->properties), prop_id);
+	}
 	blob = data_blob_talloc_named(msg->talloc_ctx, bin->lpb, bin->cb, "blob to hex");
 
 	base64 = base64_encode_data_blob(msg->talloc_ctx, blob);
@@ -246,7 +309,7 @@ zval* mapi_message_set_base64_binary_property(mapi_message_object_t* msg, mapi_i
 	bin->cb = blob.length;
 	bin->lpb = blob.data;
 
-	mapi_message_so_set_prop(msg->talloc_ctx, msg->message, prop_id, (void*) bin TSRMLS_CC);
+	mapi_message_so_set_prop(msg->talloc_ctx, mapi_message_get_object(msg TSRMLS_CC), prop_id, (void*) bin TSRMLS_CC);
 
 	efree(bin);
 	data_blob_free(&blob);
@@ -553,7 +616,7 @@ PHP_METHOD(MAPIMessage, get)
 		zval *prop;
 		zval **temp_prop;
 		mapi_id_t prop_id = (mapi_id_t) Z_LVAL_P(args[i]);
-		prop  = mapi_message_get_property(this_obj, prop_id);
+		prop  = mapi_message_get_property(this_obj, prop_id TSRMLS_CC);
 
 		if (argc == 1) {
 			result = prop;
@@ -611,7 +674,7 @@ void mapi_message_set_properties(zval *message_zval, int argc, zval **args TSRML
 		}
 
 		data = mapi_message_zval_to_mapi_value(message_obj->talloc_ctx, prop_type, val);
-		mapi_message_so_set_prop(message_obj->talloc_ctx, message_obj->message, id, data TSRMLS_CC);
+		mapi_message_so_set_prop(message_obj->talloc_ctx, mapi_message_get_object(message_obj TSRMLS_CC), id, data TSRMLS_CC);
 	}
 
 }
@@ -661,7 +724,7 @@ PHP_METHOD(MAPIMessage, save)
 	mailbox_obj = (mapi_mailbox_object_t*)  zend_object_store_get_object(folder_obj->parent TSRMLS_CC);
 
 	retval = SaveChangesMessage(&(mailbox_obj->store),
-				    this_obj->message,
+				    mapi_message_get_object(this_obj TSRMLS_CC),
 				     KeepOpenReadWrite);
 
 	CHECK_MAPI_RETVAL(retval, "Saving properties");
@@ -674,7 +737,7 @@ PHP_METHOD(MAPIMessage, getBodyContentFormat)
 	uint8_t  	      format;
 
 	this_obj    = (mapi_message_object_t *) zend_object_store_get_object(getThis() TSRMLS_CC);
-	ret = GetBestBody(this_obj->message, &format);
+	ret = GetBestBody(mapi_message_get_object(this_obj TSRMLS_CC), &format);
 	CHECK_MAPI_RETVAL(ret, "getBodyContentFormat");
 
 	switch(format) {
@@ -702,7 +765,7 @@ zval *mapi_message_get_attachment(zval *z_message, const uint32_t attach_num TSR
 	message_obj    = (mapi_message_object_t *) zend_object_store_get_object(z_message TSRMLS_CC);
 	attachment_obj = emalloc(sizeof(mapi_object_t));
 	mapi_object_init(attachment_obj);
-	retval = OpenAttach(message_obj->message, attach_num, attachment_obj);
+	retval = OpenAttach(mapi_message_get_object(message_obj TSRMLS_CC), attach_num, attachment_obj);
 	CHECK_MAPI_RETVAL(retval, "Open attachment");
 
 	z_attachment = create_attachment_object(z_message, attachment_obj TSRMLS_CC);
@@ -733,7 +796,7 @@ PHP_METHOD(MAPIMessage, getAttachmentTable)
 
 	obj_table = emalloc(sizeof(mapi_object_t));
 	mapi_object_init(obj_table);
-	retval = GetAttachmentTable(this_obj->message, obj_table);
+	retval = GetAttachmentTable(mapi_message_get_object(this_obj TSRMLS_CC), obj_table);
 	CHECK_MAPI_RETVAL(retval, "GetAttachmentTable");
 
 	z_table = create_attachment_table_object(z_this_obj, obj_table  TSRMLS_CC);
@@ -752,11 +815,12 @@ zval *mapi_message_dump(zval *z_message TSRMLS_DC)
 	array_init(dump);
 
 	message_obj = (mapi_message_object_t *) zend_object_store_get_object(z_message TSRMLS_CC);
+	mapi_message_request_all_properties(message_obj TSRMLS_CC);
 
 	for (i = 0; i < message_obj->properties.cValues; i++) {
 		zval  *prop;
 		mapi_id_t prop_id =  message_obj->properties.lpProps[i].ulPropTag;
-		prop = mapi_message_get_property(message_obj, prop_id);
+		prop = mapi_message_get_property(message_obj, prop_id TSRMLS_CC);
 		if (prop == NULL) {
 			continue;
 		} else if (ZVAL_IS_NULL(prop)) {
@@ -788,7 +852,7 @@ PHP_METHOD(MAPIMessage, getAsBase64)
 	}
 
 	this_obj    = (mapi_message_object_t *) zend_object_store_get_object(getThis() TSRMLS_CC);
-	base64 = mapi_message_get_base64_binary_property(this_obj, (mapi_id_t) prop_id);
+	base64 = mapi_message_get_base64_binary_property(this_obj, (mapi_id_t) prop_id TSRMLS_CC);
 	RETURN_ZVAL(base64, 0, 1);
 }
 
@@ -27,6 +27,8 @@ typedef struct mapi_message_object
 	TALLOC_CTX	*talloc_ctx;
 	zval		*parent;
 	char 		open_mode;
+	mapi_id_t	mid;
+	bool		properties_loaded;
 	struct mapi_SPropValue_array	properties;
 } mapi_message_object_t;
 
@@ -61,7 +63,10 @@ void MAPIMessageRegisterClass(TSRMLS_D);
 zend_object_value mapi_message_create_handler(zend_class_entry *type TSRMLS_DC);
 zval *create_message_object(char *class, zval *folder, mapi_object_t *message, char open_mode TSRMLS_DC);
 
-void mapi_message_request_all_properties(zval *z_message TSRMLS_DC);
+mapi_object_t *mapi_message_get_object(mapi_message_object_t *obj TSRMLS_DC);
+
+void mapi_message_request_all_properties(mapi_message_object_t *obj TSRMLS_DC);
+void mapi_message_prefill_properties(mapi_message_object_t *obj, struct SRow *row);
 void mapi_message_so_request_properties(mapi_message_object_t *obj, struct SPropTagArray *SPropTagArray TSRMLS_DC);
 
 void mapi_message_set_properties(zval *message_zval, int argc, zval **args TSRMLS_DC);
@@ -70,6 +75,8 @@ void mapi_message_so_set_prop(TALLOC_CTX *mem_ctx,	mapi_object_t *message, mapi_
 
 mapi_id_t mapi_message_get_id(zval *message TSRMLS_DC);
 zval* mapi_message_property_to_zval(TALLOC_CTX *talloc_ctx, mapi_id_t prop_id, void *prop_value);
+bool mapi_message_types_compatibility(zval *zv, mapi_id_t mapi_type);
+void *mapi_message_zval_to_mapi_value(TALLOC_CTX *mem_ctx, mapi_id_t mapi_type, zval *val);
 zval *mapi_message_get_attachment(zval *message, const uint32_t attach_num TSRMLS_DC);
 
 
@@ -58,6 +58,7 @@ zval *create_message_table_object(mapi_folder_type_t type, zval* folder, mapi_ob
 
 	zval *new_php_obj = create_table_object("mapimessagetable", folder, message_table,
 						talloc_ctx, tag_array, count TSRMLS_CC);
+	new_obj = (mapi_table_object_t*)  zend_object_store_get_object(new_php_obj TSRMLS_CC);
 	if (type == CONTACT) {
 		new_obj->type = CONTACTS;
 	} else if (type == APPOINTMENT) {
@@ -90,17 +91,22 @@ PHP_METHOD(MAPIMessageTable, summary)
 	struct mapi_SPropValue_array	properties_array;
 
 	long countParam = -1;
+	long offsetParam = -1;
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-			       "|l", &countParam) == FAILURE) {
+			       "|ll", &countParam, &offsetParam) == FAILURE) {
 		RETURN_NULL();
 	}
 
 	count = (countParam > 0) ? (uint32_t) countParam : 50;
 	this_obj = (mapi_table_object_t*)  zend_object_store_get_object(getThis() TSRMLS_CC);
 
+	if (offsetParam >= 0) {
+		mapi_table_seek(this_obj, (uint32_t) offsetParam TSRMLS_CC);
+	}
+
 	MAKE_STD_ZVAL(summary);
 	array_init(summary);
-	while (mapi_table_next_row_set(this_obj->table, &row_set, count TSRMLS_CC)) {
+	while (mapi_table_next_row_set(this_obj, &row_set, count TSRMLS_CC)) {
 		for (i = 0; i < row_set.cRows; i++) {
 			zval *obj_summary;
 			MAKE_STD_ZVAL(obj_summary);
@@ -145,8 +151,9 @@ PHP_METHOD(MAPIMessageTable, getMessages)
 	unsigned char open_mode = 0; //XXX
 
 	long countParam = -1;
+	long offsetParam = -1;
 	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC,
-			       "|l", &countParam) == FAILURE) {
+			       "|ll", &countParam, &offsetParam) == FAILURE) {
 		RETURN_NULL();
 	}
 
@@ -155,15 +162,16 @@ PHP_METHOD(MAPIMessageTable, getMessages)
 	folder  = this_obj->parent;
 	folder_obj = STORE_OBJECT(mapi_folder_object_t*, folder);
 
+	if (offsetParam >= 0) {
+		mapi_table_seek(this_obj, (uint32_t) offsetParam TSRMLS_CC);
+	}
+
 	MAKE_STD_ZVAL(res);
 	array_init(res);
-	while (mapi_table_next_row_set(this_obj->table,  &row, count TSRMLS_CC)) {
+	while (mapi_table_next_row_set(this_obj, &row, count TSRMLS_CC)) {
 		for (i = 0; i < row.cRows; i++) {
-			mapi_id_t message_id = row.aRow[i].lpProps[0].value.d; // message_id
-			message = mapi_folder_open_message(folder, message_id, open_mode TSRMLS_CC);
-			if (message) {
-				add_next_index_zval(res, message);
-			}
+			message = mapi_folder_listed_message(folder, &(row.aRow[i]), open_mode TSRMLS_CC);
+			add_next_index_zval(res, message);
 		}
 
 		if (countParam > 0) {
@@ -25,6 +25,8 @@ static zend_function_entry mapi_table_class_functions[] = {
  	PHP_ME(MAPITable,	count,		 NULL, ZEND_ACC_PUBLIC)
  	PHP_ME(MAPITable,	getParentFolder, NULL, ZEND_ACC_PUBLIC)
  	PHP_ME(MAPITable,	getParent,       NULL, ZEND_ACC_PUBLIC)
+ 	PHP_ME(MAPITable,	sort,		 NULL, ZEND_ACC_PUBLIC)
+ 	PHP_ME(MAPITable,	restrict,	 NULL, ZEND_ACC_PUBLIC)
 	{ NULL, NULL, NULL }
 };
 
@@ -94,6 +96,15 @@ void MAPITableRegisterClass(TSRMLS_D)
 	memcpy(&mapi_table_object_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
 
 	MAPITableClassSetObjectHandlers(&mapi_table_object_handlers);
+
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("SORT_ASCEND"), TABLE_SORT_ASCEND TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("SORT_DESCEND"), TABLE_SORT_DESCEND TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("RELOP_LT"), RELOP_LT TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("RELOP_LE"), RELOP_LE TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("RELOP_GT"), RELOP_GT TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("RELOP_GE"), RELOP_GE TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("RELOP_EQ"), RELOP_EQ TSRMLS_CC);
+	zend_declare_class_constant_long(mapi_table_ce, ZEND_STRL("RELOP_NE"), RELOP_NE TSRMLS_CC);
 }
 
 
@@ -126,22 +137,50 @@ zval *create_table_object(char *class, zval* folder_php_obj, mapi_object_t *tabl
 	return new_php_obj;
 }
 
-struct SRowSet* mapi_table_next_row_set(mapi_object_t* table, struct SRowSet *row_set, uint32_t count TSRMLS_DC)
+struct SRowSet* mapi_table_next_row_set(mapi_table_object_t *table_obj, struct SRowSet *row_set, uint32_t count TSRMLS_DC)
 {
 	enum MAPISTATUS		retval;
 	if (count == 0) {
 		php_error(E_ERROR, "Bad count parameter, must be greater than zero");
 	}
 
-	retval = QueryRows(table, count, TBL_ADVANCE, row_set);
+	retval = QueryRows(table_obj->table, count, TBL_ADVANCE, row_set);
 	if ((retval !=  MAPI_E_NOT_FOUND) && (row_set->cRows == 0)) {
 		return NULL;
 	}
 	CHECK_MAPI_RETVAL(retval, "Next row set");
+	table_obj->position += row_set->cRows;
 
 	return row_set;
 }
 
+/* The cursor position is tracked so that reading consecutive pages
+   only costs a QueryRows each */
+void mapi_table_seek(mapi_table_object_t *table_obj, uint32_t offset TSRMLS_DC)
+{
+	enum MAPISTATUS		retval;
+	uint32_t		row;
+
+	if (table_obj->position == offset) {
+		return;
+	}
+
+	retval = SeekRow(table_obj->table, BOOKMARK_BEGINNING, offset, &row);
+	CHECK_MAPI_RETVAL(retval, "Seek row");
+	table_obj->position = offset;
+}
+
+static void mapi_table_refresh_count(mapi_table_object_t *table_obj TSRMLS_DC)
+{
+	enum MAPISTATUS		retval;
+	uint32_t		numerator;
+	uint32_t		denominator;
+
+	retval = QueryPosition(table_obj->table, &numerator, &denominator);
+	CHECK_MAPI_RETVAL(retval, "Query position");
+	table_obj->position = numerator;
+	table_obj->count = denominator;
+}
 
 PHP_METHOD(MAPITable, __construct)
 {
@@ -177,3 +216,88 @@ PHP_METHOD(MAPITable, getParent)
 	mapi_table_object_t *this_obj = THIS_STORE_OBJECT(mapi_table_object_t*);
 	RETURN_ZVAL(this_obj->parent, 0, 0);
 }
+
+/* sort(propId, order [, propId, order ...]) */
+PHP_METHOD(MAPITable, sort)
+{
+	int			argc = ZEND_NUM_ARGS();
+	zval			**args;
+	mapi_table_object_t	*this_obj;
+	struct SSortOrderSet	criteria;
+	enum MAPISTATUS		retval;
+	int			i;
+
+	if ((argc == 0) || ((argc % 2) == 1)) {
+		WRONG_PARAM_COUNT;
+	}
+
+	args = (zval **)safe_emalloc(argc, sizeof(zval **), 0);
+	if (zend_get_parameters_array(UNUSED_PARAM, argc, args) == FAILURE) {
+		efree(args);
+		WRONG_PARAM_COUNT;
+	}
+	for (i=0; i < argc; i++) {
+		if (Z_TYPE_P(args[i]) != IS_LONG) {
+			efree(args);
+			php_error(E_ERROR, "sort() only accepts pairs of property ID and sort order");
+		}
+	}
+
+	this_obj = THIS_STORE_OBJECT(mapi_table_object_t*);
+
+	memset(&criteria, 0x0, sizeof (struct SSortOrderSet));
+	criteria.cSorts = argc / 2;
+	criteria.aSort = talloc_array(this_obj->talloc_ctx, struct SSortOrder, criteria.cSorts);
+	for (i=0; i < criteria.cSorts; i++) {
+		criteria.aSort[i].ulPropTag = (uint32_t) Z_LVAL_P(args[2*i]);
+		criteria.aSort[i].ulOrder = (Z_LVAL_P(args[2*i + 1]) == TABLE_SORT_DESCEND) ? TABLE_SORT_DESCEND : TABLE_SORT_ASCEND;
+	}
+	efree(args);
+
+	retval = SortTable(this_obj->table, &criteria);
+	talloc_free(criteria.aSort);
+	CHECK_MAPI_RETVAL(retval, "Sort table");
+
+	/* sorting moves the cursor back to the beginning of the table */
+	this_obj->position = 0;
+}
+
+/* restrict(propId, relop, value) */
+PHP_METHOD(MAPITable, restrict)
+{
+	long			prop_id;
+	long			relop;
+	zval			*value;
+	void			*data;
+	mapi_table_object_t	*this_obj;
+	struct mapi_SRestriction	res;
+	uint8_t			table_status;
+	enum MAPISTATUS		retval;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "llz",
+				  &prop_id, &relop, &value) == FAILURE) {
+		php_error(E_ERROR, "restrict invalid arguments. Must be: property ID, relational operator, value");
+	}
+	if ((relop < RELOP_LT) || (relop > RELOP_NE)) {
+		php_error(E_ERROR, "Unknown relational operator: %ld", relop);
+	}
+	if (mapi_message_types_compatibility(value, prop_id & 0xFFFF) == false) {
+		php_error(E_ERROR, "Value type does not match property 0x%lX", prop_id);
+	}
+
+	this_obj = THIS_STORE_OBJECT(mapi_table_object_t*);
+
+	data = mapi_message_zval_to_mapi_value(this_obj->talloc_ctx, prop_id & 0xFFFF, value);
+	res.rt = RES_PROPERTY;
+	res.res.resProperty.relop = relop;
+	res.res.resProperty.ulPropTag = prop_id;
+	if (set_mapi_SPropValue_proptag(this_obj->talloc_ctx, &(res.res.resProperty.lpProp), prop_id, data) == false) {
+		php_error(E_ERROR, "Property 0x%lX cannot be used in a restriction", prop_id);
+	}
+
+	retval = Restrict(this_obj->table, &res, &table_status);
+	CHECK_MAPI_RETVAL(retval, "Restrict table");
+
+	/* the row count now reflects the restriction */
+	mapi_table_refresh_count(this_obj TSRMLS_CC);
+}
@@ -31,6 +31,7 @@ typedef struct mapi_table_object
 	enum table_type	type;
 	TALLOC_CTX	*talloc_ctx;
 	struct SPropTagArray	*tag_array;
+	uint32_t	position;
 } mapi_table_object_t;
 
 #ifndef __BEGIN_DECLS
@@ -50,13 +51,16 @@ PHP_METHOD(MAPITable, __destruct);
 PHP_METHOD(MAPITable, count);
 PHP_METHOD(MAPITable, getParent);
 PHP_METHOD(MAPITable, getParentFolder); // XXX will be deprecated in the future
+PHP_METHOD(MAPITable, sort);
+PHP_METHOD(MAPITable, restrict);
 
 void MAPITableRegisterClass(TSRMLS_D);
 void mapi_table_free_storage(void *object TSRMLS_DC);
 zend_object_value mapi_table_create_handler(zend_class_entry *type TSRMLS_DC);
 void MAPITableClassSetObjectHandlers(zend_object_handlers *handler);
 zval *create_table_object(char *class, zval* folder_php_obj, mapi_object_t *table, TALLOC_CTX *talloc_ctx, struct SPropTagArray *tag_array, uint count TSRMLS_DC);
-struct SRowSet* mapi_table_next_row_set(mapi_object_t* table, struct SRowSet *row_set, uint32_t count TSRMLS_DC);
+struct SRowSet* mapi_table_next_row_set(mapi_table_object_t *table_obj, struct SRowSet *row_set, uint32_t count TSRMLS_DC);
+void mapi_table_seek(mapi_table_object_t *table_obj, uint32_t offset TSRMLS_DC);
 
 
 __END_DECLS
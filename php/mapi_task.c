@@ -45,7 +45,6 @@ void MAPITaskRegisterClass(TSRMLS_D)
 zval *create_task_object(zval *folder, mapi_object_t *message, char open_mode TSRMLS_DC)
 {
 	zval *task = create_message_object("mapitask", folder, message, open_mode TSRMLS_CC);
-	mapi_message_request_all_properties(task TSRMLS_CC);
 	return task;
 }
 
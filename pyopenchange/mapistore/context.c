@@ -27,7 +27,9 @@ static void py_MAPIStoreContext_dealloc(PyObject *_self)
 {
 	PyMAPIStoreContextObject *self = (PyMAPIStoreContextObject *) _self;
 
+	PYMAPISTORE_BEGIN_CALL(self->parent);
 	mapistore_del_context(self->mstore_ctx, self->context_id);
+	PYMAPISTORE_END_CALL(self->parent);
 	Py_XDECREF(self->parent);
 	PyObject_Del(_self);
 }
@@ -53,10 +53,12 @@ static PyObject *py_MAPIStoreFolder_create_folder(PyMAPIStoreFolderObject *self,
 	}
 
 	/* Step 1. Check if the folder already exists */
+	PYMAPISTORE_BEGIN_CALL(self->context->parent);
 	ret = mapistore_folder_get_child_fid_by_name(self->context->mstore_ctx,
 						     self->context->context_id,
 						     self->context->folder_object, 
 						     name, &fid);
+	PYMAPISTORE_END_CALL(self->context->parent);
 	if (ret == MAPISTORE_SUCCESS) {
 		if (flags != OPEN_IF_EXISTS) {
 			PyErr_SetMAPIStoreError(ret);
@@ -85,9 +87,11 @@ static PyObject *py_MAPIStoreFolder_get_child_count(PyMAPIStoreFolderObject *sel
 		return NULL;
 	}
 
+	PYMAPISTORE_BEGIN_CALL(self->context->parent);
 	retval = mapistore_folder_get_child_count(self->context->mstore_ctx, self->context->context_id,
 						  (self->folder_object ? self->folder_object : 
 						   self->context->folder_object), table_type, &RowCount);
+	PYMAPISTORE_END_CALL(self->context->parent);
 	if (retval != MAPISTORE_SUCCESS) {
 		return PyInt_FromLong(-1);
 	}
@@ -95,6 +99,41 @@ static PyObject *py_MAPIStoreFolder_get_child_count(PyMAPIStoreFolderObject *sel
 	return PyInt_FromLong(RowCount);
 }
 
+static PyObject *py_MAPIStoreFolder_open_table(PyMAPIStoreFolderObject *self, PyObject *args, PyObject *kwargs)
+{
+	PyMAPIStoreTableObject		*table;
+	enum mapistore_table_type	table_type;
+	char				*kwnames[] = { "table_type", NULL };
+	enum mapistore_error		retval;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "i", kwnames, &table_type)) {
+		return NULL;
+	}
+
+	table = PyObject_New(PyMAPIStoreTableObject, &PyMAPIStoreTable);
+	if (!table) {
+		return NULL;
+	}
+	table->mem_ctx = talloc_new(NULL);
+	table->folder = self;
+	Py_INCREF(self);
+	table->table_type = table_type;
+
+	PYMAPISTORE_BEGIN_CALL(self->context->parent);
+	retval = mapistore_folder_open_table(self->context->mstore_ctx, self->context->context_id,
+					     (self->folder_object ? self->folder_object :
+					      self->context->folder_object), table->mem_ctx, table_type, 0,
+					     &table->table_object, &table->row_count);
+	PYMAPISTORE_END_CALL(self->context->parent);
+	if (retval != MAPISTORE_SUCCESS) {
+		Py_DECREF(table);
+		PyErr_SetMAPIStoreError(retval);
+		return NULL;
+	}
+
+	return (PyObject *)table;
+}
+
 static void convert_datetime_to_tm(TALLOC_CTX *mem_ctx, PyObject *datetime, struct tm *tm)
 {
 	PyObject *value;
@@ -169,7 +208,9 @@ static PyObject *py_MAPIStoreFolder_fetch_freebusy_properties(PyMAPIStoreFolderO
 		end_tm = NULL;
 	}
 
+	PYMAPISTORE_BEGIN_CALL(self->context->parent);
 	retval = mapistore_folder_fetch_freebusy_properties(self->context->mstore_ctx, self->context->context_id, self->folder_object, start_tm, end_tm, mem_ctx, &fb_props);
+	PYMAPISTORE_END_CALL(self->context->parent);
 	if (retval != MAPISTORE_SUCCESS) {
 		PyErr_SetMAPIStoreError(retval);
 		goto end;
@@ -185,6 +226,7 @@ end:
 static PyMethodDef mapistore_folder_methods[] = {
 	{ "create_folder", (PyCFunction)py_MAPIStoreFolder_create_folder, METH_VARARGS|METH_KEYWORDS },
 	{ "get_child_count", (PyCFunction)py_MAPIStoreFolder_get_child_count, METH_VARARGS|METH_KEYWORDS },
+	{ "open_table", (PyCFunction)py_MAPIStoreFolder_open_table, METH_VARARGS|METH_KEYWORDS },
 	{ "fetch_freebusy_properties", (PyCFunction)py_MAPIStoreFolder_fetch_freebusy_properties, METH_VARARGS|METH_KEYWORDS },
 	{ NULL },
 };
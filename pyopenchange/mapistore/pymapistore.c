@@ -45,12 +45,13 @@ PyMAPIStoreGlobals *get_PyMAPIStoreGlobals()
 	return &globals;
 }
 
-static void sam_ldb_init(const char *syspath)
+static struct ldb_context *sam_ldb_init(TALLOC_CTX *parent_ctx, const char *syspath)
 {
 	TALLOC_CTX		*mem_ctx;
 	/* char			*ldb_path; */
 	struct loadparm_context *lp_ctx;
 	struct tevent_context	*ev;
+	struct ldb_context	*samdb_ctx = NULL;
 	int			ret;
 	struct ldb_result	*res;
 	struct ldb_dn		*tmp_dn = NULL;
@@ -60,9 +61,6 @@ static void sam_ldb_init(const char *syspath)
 		NULL
 	};
 
-	/* Sanity checks */
-	if (globals.samdb_ctx) return;
-
 	mem_ctx = talloc_zero(NULL, TALLOC_CTX);
 
 	ev = tevent_context_init(talloc_autofree_context());
@@ -73,35 +71,40 @@ static void sam_ldb_init(const char *syspath)
 
 	/* Step 2. Connect to the database */
 	lp_ctx = loadparm_init_global(true);
-	globals.samdb_ctx = samdb_connect(NULL, NULL, lp_ctx, system_session(lp_ctx), 0);
-	if (!globals.samdb_ctx) goto end;
+	samdb_ctx = samdb_connect(parent_ctx, NULL, lp_ctx, system_session(lp_ctx), 0);
+	if (!samdb_ctx) goto end;
 
 	/* Step 3. Search for rootDSE record */
-	ret = ldb_search(globals.samdb_ctx, mem_ctx, &res, ldb_dn_new(mem_ctx, globals.samdb_ctx, "@ROOTDSE"),
+	ret = ldb_search(samdb_ctx, mem_ctx, &res, ldb_dn_new(mem_ctx, samdb_ctx, "@ROOTDSE"),
 			 LDB_SCOPE_BASE, attrs, NULL);
-	if (ret != LDB_SUCCESS) goto end;
-	if (res->count != 1) goto end;
+	if (ret != LDB_SUCCESS) goto failed;
+	if (res->count != 1) goto failed;
 
 	/* Step 4. Set opaque naming */
-	tmp_dn = ldb_msg_find_attr_as_dn(globals.samdb_ctx, globals.samdb_ctx,
+	tmp_dn = ldb_msg_find_attr_as_dn(samdb_ctx, samdb_ctx,
 					 res->msgs[0], "rootDomainNamingContext");
-	ldb_set_opaque(globals.samdb_ctx, "rootDomainNamingContext", tmp_dn);
+	ldb_set_opaque(samdb_ctx, "rootDomainNamingContext", tmp_dn);
 	
-	tmp_dn = ldb_msg_find_attr_as_dn(globals.samdb_ctx, globals.samdb_ctx,
+	tmp_dn = ldb_msg_find_attr_as_dn(samdb_ctx, samdb_ctx,
 					 res->msgs[0], "defaultNamingContext");
-	ldb_set_opaque(globals.samdb_ctx, "defaultNamingContext", tmp_dn);
+	ldb_set_opaque(samdb_ctx, "defaultNamingContext", tmp_dn);
 
 end:
 	talloc_free(mem_ctx);
+	return samdb_ctx;
+
+failed:
+	talloc_free(samdb_ctx);
+	talloc_free(mem_ctx);
+	return NULL;
 }
 
-static void openchange_ldb_init(const char *syspath)
+static struct openchangedb_context *openchange_ldb_init(TALLOC_CTX *parent_ctx, const char *syspath)
 {
-	TALLOC_CTX 		*mem_ctx;
-	struct loadparm_context *lp_ctx;
-	const char		*openchangedb_backend;
-
-	if (globals.ocdb_ctx) return;
+	TALLOC_CTX 			*mem_ctx;
+	struct loadparm_context		*lp_ctx;
+	const char			*openchangedb_backend;
+	struct openchangedb_context	*ocdb_ctx = NULL;
 
 	mem_ctx = talloc_zero(NULL, TALLOC_CTX);
 	lp_ctx = loadparm_init_global(true);
@@ -111,18 +114,19 @@ static void openchange_ldb_init(const char *syspath)
 		PyErr_SetString(PyExc_SystemError, "No openchangedb backend configured.");
 		goto end;
 	} else if (strncmp(openchangedb_backend, "mysql:", strlen("mysql:")) == 0) {
-		openchangedb_mysql_initialize(mem_ctx, lp_ctx, &globals.ocdb_ctx);
+		openchangedb_mysql_initialize(mem_ctx, lp_ctx, &ocdb_ctx);
 	} else if (strncmp(openchangedb_backend, "ldb:", strlen("ldb:")) == 0) {
-		openchangedb_ldb_initialize(mem_ctx, syspath, &globals.ocdb_ctx);
+		openchangedb_ldb_initialize(mem_ctx, syspath, &ocdb_ctx);
 	}
 
-	if (!globals.ocdb_ctx) {
+	if (!ocdb_ctx) {
 		PyErr_SetString(PyExc_SystemError, "Cannot initialize openchangedb backend");
 		goto end;
 	}
-	(void) talloc_reference(NULL, globals.ocdb_ctx);
+	(void) talloc_reference(parent_ctx, ocdb_ctx);
 end:
 	talloc_free(mem_ctx);
+	return ocdb_ctx;
 }
 
 static PyObject *py_MAPIStore_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
@@ -130,6 +134,8 @@ static PyObject *py_MAPIStore_new(PyTypeObject *type, PyObject *args, PyObject *
 	TALLOC_CTX			*mem_ctx;
 	struct loadparm_context		*lp_ctx;
 	struct mapistore_context	*mstore_ctx;
+	struct ldb_context		*samdb_ctx;
+	struct openchangedb_context	*ocdb_ctx;
 	PyMAPIStoreObject		*msobj;
 	char				*kwnames[] = { "syspath", "path", NULL };
 	const char			*path = NULL;
@@ -139,23 +145,28 @@ static PyObject *py_MAPIStore_new(PyTypeObject *type, PyObject *args, PyObject *
 		return NULL;
 	}
 
-	/* Initialize ldb context on sam.ldb */
-	sam_ldb_init(syspath);
-	if (globals.samdb_ctx == NULL) {
-		PyErr_SetString(PyExc_SystemError,
-				"error in sam_ldb_init");
-		return NULL;
-	}
-
 	mem_ctx = talloc_new(NULL);
 	if (mem_ctx == NULL) {
 		PyErr_NoMemory();
 		return NULL;
 	}
 
+	/* Each session has its own database connections, the process
+	   wide loadparm context they are set up from is only read with
+	   the GIL held */
+
+	/* Initialize ldb context on sam.ldb */
+	samdb_ctx = sam_ldb_init(mem_ctx, syspath);
+	if (samdb_ctx == NULL) {
+		PyErr_SetString(PyExc_SystemError,
+				"error in sam_ldb_init");
+		talloc_free(mem_ctx);
+		return NULL;
+	}
+
 	/* Initialize ldb context on openchange.ldb */
-	openchange_ldb_init(syspath);
-	if (globals.ocdb_ctx == NULL) {
+	ocdb_ctx = openchange_ldb_init(mem_ctx, syspath);
+	if (ocdb_ctx == NULL) {
 		PyErr_SetString(PyExc_SystemError,
 				"error in openchange_ldb_init");
 		talloc_free(mem_ctx);
@@ -176,8 +187,16 @@ static PyObject *py_MAPIStore_new(PyTypeObject *type, PyObject *args, PyObject *
 	}
 
 	msobj = PyObject_New(PyMAPIStoreObject, &PyMAPIStore);
+	if (msobj == NULL) {
+		mapistore_release(mstore_ctx);
+		talloc_free(mem_ctx);
+		return NULL;
+	}
 	msobj->mem_ctx = mem_ctx;
 	msobj->mstore_ctx = mstore_ctx;
+	msobj->samdb_ctx = samdb_ctx;
+	msobj->ocdb_ctx = ocdb_ctx;
+	pthread_mutex_init(&msobj->lock, NULL);
 
 	return (PyObject *) msobj;
 }
@@ -186,8 +205,10 @@ static void py_MAPIStore_dealloc(PyObject *_self)
 {
 	PyMAPIStoreObject *self = (PyMAPIStoreObject *)_self;
 
+	/* The last reference is gone, no other thread uses the session */
 	mapistore_release(self->mstore_ctx);
 	talloc_free(self->mem_ctx);
+	pthread_mutex_destroy(&self->lock);
 	PyObject_Del(_self);
 }
 
@@ -207,21 +228,17 @@ static PyObject *py_MAPIStore_add_context(PyMAPIStoreObject *self, PyObject *arg
 
 	/* printf("Add context: %s\n", uri); */
 
+	PYMAPISTORE_BEGIN_CALL(self);
 	/* Initialize connection info */
-	ret = mapistore_set_connection_info(self->mstore_ctx, globals.samdb_ctx, globals.ocdb_ctx, username);
-	if (ret != MAPISTORE_SUCCESS) {
-		PyErr_SetMAPIStoreError(ret);
-		return NULL;
+	ret = mapistore_set_connection_info(self->mstore_ctx, self->samdb_ctx, self->ocdb_ctx, username);
+	if (ret == MAPISTORE_SUCCESS) {
+		/* Get FID given mapistore_uri and username */
+		ret = openchangedb_get_fid(self->ocdb_ctx, uri, &fid);
 	}
-
-	/* Get FID given mapistore_uri and username */
-	ret = openchangedb_get_fid(globals.ocdb_ctx, uri, &fid);
-	if (ret != MAPISTORE_SUCCESS) {
-		PyErr_SetMAPIStoreError(ret);
-		return NULL;
+	if (ret == MAPISTORE_SUCCESS) {
+		ret = mapistore_add_context(self->mstore_ctx, username, uri, fid, &context_id, &folder_object);
 	}
-
-	ret = mapistore_add_context(self->mstore_ctx, username, uri, fid, &context_id, &folder_object);
+	PYMAPISTORE_END_CALL(self);
 	if (ret != MAPISTORE_SUCCESS) {
 		PyErr_SetMAPIStoreError(ret);
 		return NULL;
@@ -478,6 +495,9 @@ void initmapistore(void)
 
 	memset(&globals, 0, sizeof(PyMAPIStoreGlobals));
 
+	/* blocking calls release the GIL */
+	PyEval_InitThreads();
+
 	load_modules();
 
 	m = Py_InitModule3("mapistore", py_mapistore_global_methods,
@@ -29,18 +29,22 @@
 #include "mapiproxy/libmapiproxy/backends/openchangedb_ldb.h"
 #include "mapiproxy/libmapiproxy/backends/openchangedb_mysql.h"
 #include <tevent.h>
+#include <pthread.h>
 
 typedef struct {
 	PyObject		*datetime_module;
 	PyObject		*datetime_datetime_class;
-	struct ldb_context	*samdb_ctx;
-	struct openchangedb_context *ocdb_ctx;
 } PyMAPIStoreGlobals;
 
+/* A mapistore session. It owns its database connections, so that
+   threads using different sessions do not share any state */
 typedef struct {
 	PyObject_HEAD
 	TALLOC_CTX			*mem_ctx;
 	struct mapistore_context	*mstore_ctx;
+	struct ldb_context		*samdb_ctx;
+	struct openchangedb_context	*ocdb_ctx;
+	pthread_mutex_t			lock;
 } PyMAPIStoreObject;
 
 typedef struct {
@@ -79,12 +83,29 @@ typedef struct {
 
 typedef struct {
 	PyObject_HEAD	
+	TALLOC_CTX			*mem_ctx;
+	PyMAPIStoreFolderObject		*folder;
+	void				*table_object;
+	enum mapistore_table_type	table_type;
+	uint32_t			row_count;
 } PyMAPIStoreTableObject;
 
+/* Owns the rows of a table.rows() call, binary values point into them */
+typedef struct {
+	PyObject_HEAD
+	TALLOC_CTX			*mem_ctx;
+} PyMAPIStoreRowsObject;
+
+/* Release the GIL around blocking calls on the session of a
+   PyMAPIStoreObject, calls on the same session are serialized */
+#define	PYMAPISTORE_BEGIN_CALL(store)	Py_BEGIN_ALLOW_THREADS pthread_mutex_lock(&(store)->lock);
+#define	PYMAPISTORE_END_CALL(store)	pthread_mutex_unlock(&(store)->lock); Py_END_ALLOW_THREADS
+
 PyAPI_DATA(PyTypeObject)	PyMAPIStore;
 PyAPI_DATA(PyTypeObject)	PyMAPIStoreContext;
 PyAPI_DATA(PyTypeObject)	PyMAPIStoreFolder;
 PyAPI_DATA(PyTypeObject)	PyMAPIStoreTable;
+PyAPI_DATA(PyTypeObject)	PyMAPIStoreRows;
 
 #ifndef __BEGIN_DECLS
 #ifdef __cplusplus
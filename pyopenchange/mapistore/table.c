@@ -9,12 +9,12 @@
    it under the terms of the GNU General Public License as published by
    the Free Software Foundation; either version 3 of the License, or
    (at your option) any later version.
-   
+
    This program is distributed in the hope that it will be useful,
    but WITHOUT ANY WARRANTY; without even the implied warranty of
    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
    GNU General Public License for more details.
-   
+
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
@@ -23,16 +23,259 @@
 #include "pyopenchange/mapistore/pymapistore.h"
 #include "gen_ndr/exchange.h"
 
+static void py_MAPIStoreRows_dealloc(PyObject *_self)
+{
+	PyMAPIStoreRowsObject *self = (PyMAPIStoreRowsObject *)_self;
+
+	talloc_free(self->mem_ctx);
+	PyObject_Del(_self);
+}
+
+PyTypeObject PyMAPIStoreRows = {
+	PyObject_HEAD_INIT(NULL) 0,
+	.tp_name = "MAPIStoreRows",
+	.tp_basicsize = sizeof (PyMAPIStoreRowsObject),
+	.tp_doc = "memory of the rows returned by a mapistore table",
+	.tp_dealloc = (destructor)py_MAPIStoreRows_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+};
+
+/* A read-only memoryview on data owned by rows, which it keeps alive */
+static PyObject *py_MAPIStoreRows_view(PyMAPIStoreRowsObject *rows, const uint8_t *data, Py_ssize_t length)
+{
+	Py_buffer	view;
+
+	if (PyBuffer_FillInfo(&view, (PyObject *)rows, (void *)data, length, 1, PyBUF_FULL_RO) == -1) {
+		return NULL;
+	}
+
+	return PyMemoryView_FromBuffer(&view);
+}
+
+static PyObject *py_MAPIStoreTable_value(PyMAPIStoreRowsObject *rows, enum MAPITAGS tag, const void *data)
+{
+	PyObject	*list;
+	PyObject	*item;
+	uint32_t	i;
+
+	switch (tag & 0xFFFF) {
+	case PT_SHORT:
+		return PyInt_FromLong(*(const uint16_t *)data);
+	case PT_LONG:
+	case PT_ERROR:
+		return PyLong_FromUnsignedLong(*(const uint32_t *)data);
+	case PT_BOOLEAN:
+		return PyBool_FromLong(*(const uint8_t *)data);
+	case PT_DOUBLE:
+		return PyFloat_FromDouble(*(const double *)data);
+	case PT_I8:
+		return PyLong_FromUnsignedLongLong(*(const uint64_t *)data);
+	case PT_SYSTIME:
+	{
+		const struct FILETIME	*ft = (const struct FILETIME *)data;
+
+		/* Left as a FILETIME, building datetime objects costs more than the fetch */
+		return PyLong_FromUnsignedLongLong(((uint64_t)ft->dwHighDateTime << 32) | ft->dwLowDateTime);
+	}
+	case PT_STRING8:
+	case PT_UNICODE:
+		return PyString_FromString((const char *)data);
+	case PT_CLSID:
+		return py_MAPIStoreRows_view(rows, (const uint8_t *)data, sizeof (struct GUID));
+	case PT_BINARY:
+	{
+		const struct Binary_r	*bin = (const struct Binary_r *)data;
+
+		return py_MAPIStoreRows_view(rows, bin->lpb, bin->cb);
+	}
+	case PT_MV_LONG:
+	{
+		const struct LongArray_r	*array = (const struct LongArray_r *)data;
+
+		list = PyList_New(array->cValues);
+		for (i = 0; list && i < array->cValues; i++) {
+			PyList_SET_ITEM(list, i, PyLong_FromUnsignedLong(array->lpl[i]));
+		}
+		return list;
+	}
+	case PT_MV_STRING8:
+	{
+		const struct StringArray_r	*array = (const struct StringArray_r *)data;
+
+		list = PyList_New(array->cValues);
+		for (i = 0; list && i < array->cValues; i++) {
+			PyList_SET_ITEM(list, i, PyString_FromString(array->lppszA[i]));
+		}
+		return list;
+	}
+	case PT_MV_UNICODE:
+	{
+		const struct StringArrayW_r	*array = (const struct StringArrayW_r *)data;
+
+		list = PyList_New(array->cValues);
+		for (i = 0; list && i < array->cValues; i++) {
+			PyList_SET_ITEM(list, i, PyString_FromString(array->lppszW[i]));
+		}
+		return list;
+	}
+	case PT_MV_BINARY:
+	{
+		const struct BinaryArray_r	*array = (const struct BinaryArray_r *)data;
+
+		list = PyList_New(array->cValues);
+		for (i = 0; list && i < array->cValues; i++) {
+			item = py_MAPIStoreRows_view(rows, array->lpbin[i].lpb, array->lpbin[i].cb);
+			if (!item) {
+				Py_DECREF(list);
+				return NULL;
+			}
+			PyList_SET_ITEM(list, i, item);
+		}
+		return list;
+	}
+	default:
+		Py_RETURN_NONE;
+	}
+}
+
 static void py_MAPIStoreTable_dealloc(PyObject *_self)
 {
+	PyMAPIStoreTableObject *self = (PyMAPIStoreTableObject *)_self;
+
+	/* releasing the table object calls into its backend */
+	PYMAPISTORE_BEGIN_CALL(self->folder->context->parent);
+	talloc_free(self->mem_ctx);
+	PYMAPISTORE_END_CALL(self->folder->context->parent);
+	Py_XDECREF(self->folder);
 	PyObject_Del(_self);
 }
 
+static PyObject *py_MAPIStoreTable_rows(PyMAPIStoreTableObject *self, PyObject *args, PyObject *kwargs)
+{
+	PyMAPIStoreContextObject	*context = self->folder->context;
+	PyMAPIStoreRowsObject		*rows;
+	PyObject			*columns;
+	PyObject			*result;
+	PyObject			*values;
+	PyObject			*value;
+	char				*kwnames[] = { "start", "count", "columns", NULL };
+	unsigned int			start;
+	unsigned int			count;
+	enum MAPITAGS			*tags;
+	uint16_t			tag_count;
+	struct mapistore_property_data	**data;
+	uint32_t			fetched;
+	uint32_t			i;
+	uint16_t			j;
+	enum mapistore_error		retval;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "IIO", kwnames, &start, &count, &columns)) {
+		return NULL;
+	}
+
+	columns = PySequence_Fast(columns, "columns must be a sequence of property tags");
+	if (!columns) {
+		return NULL;
+	}
+	if (PySequence_Fast_GET_SIZE(columns) > 0xFFFF) {
+		Py_DECREF(columns);
+		PyErr_SetString(PyExc_ValueError, "too many columns");
+		return NULL;
+	}
+	tag_count = PySequence_Fast_GET_SIZE(columns);
+
+	rows = PyObject_New(PyMAPIStoreRowsObject, &PyMAPIStoreRows);
+	if (!rows) {
+		Py_DECREF(columns);
+		return NULL;
+	}
+	rows->mem_ctx = talloc_new(NULL);
+
+	tags = talloc_array(rows->mem_ctx, enum MAPITAGS, tag_count ? tag_count : 1);
+	for (j = 0; j < tag_count; j++) {
+		tags[j] = PyInt_AsUnsignedLongMask(PySequence_Fast_GET_ITEM(columns, j));
+	}
+	Py_DECREF(columns);
+	if (PyErr_Occurred()) {
+		Py_DECREF(rows);
+		return NULL;
+	}
+
+	result = PyDict_New();
+	if (!result) {
+		Py_DECREF(rows);
+		return NULL;
+	}
+
+	/* A range past the end of the table is an empty result */
+	fetched = 0;
+	PYMAPISTORE_BEGIN_CALL(context->parent);
+	retval = mapistore_table_set_columns(context->mstore_ctx, context->context_id, self->table_object, tag_count, tags);
+	if (retval == MAPISTORE_SUCCESS && count && start < self->row_count) {
+		retval = mapistore_table_get_rows(context->mstore_ctx, context->context_id, self->table_object, rows->mem_ctx,
+						  MAPISTORE_PREFILTERED_QUERY, start, count, &data, &fetched);
+	}
+	PYMAPISTORE_END_CALL(context->parent);
+	if (retval != MAPISTORE_SUCCESS) {
+		PyErr_SetMAPIStoreError(retval);
+		goto error;
+	}
+
+	/* One list per column, binary values are views on the fetched rows */
+	for (j = 0; j < tag_count; j++) {
+		values = PyList_New(fetched);
+		if (!values) goto error;
+
+		for (i = 0; i < fetched; i++) {
+			if (data[i][j].error == MAPISTORE_SUCCESS && data[i][j].data) {
+				value = py_MAPIStoreTable_value(rows, tags[j], data[i][j].data);
+			} else {
+				Py_INCREF(Py_None);
+				value = Py_None;
+			}
+			if (!value) {
+				Py_DECREF(values);
+				goto error;
+			}
+			PyList_SET_ITEM(values, i, value);
+		}
+
+		value = PyLong_FromUnsignedLong(tags[j]);
+		if (!value || PyDict_SetItem(result, value, values) == -1) {
+			Py_XDECREF(value);
+			Py_DECREF(values);
+			goto error;
+		}
+		Py_DECREF(value);
+		Py_DECREF(values);
+	}
+
+	Py_DECREF(rows);
+	return result;
+
+error:
+	Py_DECREF(result);
+	Py_DECREF(rows);
+	return NULL;
+}
+
+static PyObject *py_MAPIStoreTable_get_row_count(PyMAPIStoreTableObject *self, void *closure)
+{
+	return PyInt_FromLong(self->row_count);
+}
+
 static PyMethodDef mapistore_table_methods[] = {
+	{ "rows", (PyCFunction)py_MAPIStoreTable_rows, METH_VARARGS|METH_KEYWORDS,
+	  "rows(start, count, columns) -> dict of column lists\n\n"
+	  "Fetch count rows from start in a single call. The result maps each\n"
+	  "property tag of columns to the list of its values, None where a row\n"
+	  "has no such property. Binary values are read-only memoryviews on the\n"
+	  "fetched rows, times are FILETIME integers." },
 	{ NULL },
 };
 
 static PyGetSetDef mapistore_table_getsetters[] = {
+	{ (char *)"row_count", (getter)py_MAPIStoreTable_get_row_count, NULL, NULL },
 	{ NULL }
 };
 
@@ -53,4 +296,16 @@ void initmapistore_table(PyObject *m)
 		return;
 	}
 	Py_INCREF(&PyMAPIStoreTable);
+
+	if (PyType_Ready(&PyMAPIStoreRows) < 0) {
+		return;
+	}
+	Py_INCREF(&PyMAPIStoreRows);
+
+	PyModule_AddObject(m, "FOLDER_TABLE", PyInt_FromLong(MAPISTORE_FOLDER_TABLE));
+	PyModule_AddObject(m, "MESSAGE_TABLE", PyInt_FromLong(MAPISTORE_MESSAGE_TABLE));
+	PyModule_AddObject(m, "FAI_TABLE", PyInt_FromLong(MAPISTORE_FAI_TABLE));
+	PyModule_AddObject(m, "RULE_TABLE", PyInt_FromLong(MAPISTORE_RULE_TABLE));
+	PyModule_AddObject(m, "ATTACHMENT_TABLE", PyInt_FromLong(MAPISTORE_ATTACHMENT_TABLE));
+	PyModule_AddObject(m, "PERMISSIONS_TABLE", PyInt_FromLong(MAPISTORE_PERMISSIONS_TABLE));
 }
@@ -29,6 +29,7 @@ from urlparse import urlparse
 import uuid
 import time
 import MySQLdb
+import MySQLdb.cursors
 
 
 from openchange.migration import MigrationManager
@@ -56,6 +57,35 @@ def _public_folders_meta(names):
              }, 1)
 
 
+# Last folder id reserved for public folders, see openchangedb_mysql.h
+MAX_PUBLIC_FOLDER_ID = 1000
+
+# SystemIdx of the mailbox folders, see enum emsmdbp_mailbox_systemidx
+MAILBOX_ROOT_SYSTEMIDX = 1
+TOP_INFORMATION_STORE_SYSTEMIDX = 12
+
+# Search folders: SystemIdx, provisioning_folders column, container class
+_MAILBOX_SEARCH_FOLDERS = ((9, "reminders", "Outlook.Reminder"),
+                           (10, "todo", "IPF.Task"),
+                           (11, "tracked_mail_processing", "IPF.Note"))
+
+# Attributes searched by the LDB backend, see openchangedb_ldb.c
+_LDB_INDEXED_ATTRIBUTES = ("cn", "PidTagFolderId", "PidTagParentFolderId",
+                           "MAPIStoreURI", "SystemIdx")
+
+# Folder ids and change numbers taken by each bulk provisioned mailbox
+_MAILBOX_BULK_IDS = 2 + len(_MAILBOX_SEARCH_FOLDERS)
+
+
+def _chunks(items, size):
+    for i in xrange(0, len(items), size):
+        yield items[i:i + size]
+
+
+def _in_clause(values):
+    return "(%s)" % ", ".join(["%s"] * len(values))
+
+
 class OpenChangeDBWithLdbBackend(object):
     """The OpenChange database."""
 
@@ -79,17 +109,37 @@ dn: @OPTIONS
 checkBaseOnSearch: TRUE
 
 dn: @INDEXLIST
-@IDXATTR: cn
+%s
 
 dn: @ATTRIBUTES
 cn: CASE_INSENSITIVE
 dn: CASE_INSENSITIVE
 
-""")
+""" % "\n".join("@IDXATTR: %s" % attr for attr in _LDB_INDEXED_ATTRIBUTES))
         self.reopen()
         if names:
             self.add_rootDSE(names.ocserverdn, names.firstorg, names.firstou)
 
+    def reindex(self):
+        """Index the attributes searched by the server in an existing
+        database. LDB rebuilds the indexes when @INDEXLIST changes."""
+        dn = ldb.Dn(self.ldb, "@INDEXLIST")
+        res = self.ldb.search(dn, scope=ldb.SCOPE_BASE, attrs=["@IDXATTR"])
+        current = set()
+        if len(res) and "@IDXATTR" in res[0]:
+            current = set(str(attr) for attr in res[0]["@IDXATTR"])
+        attrs = sorted(current.union(_LDB_INDEXED_ATTRIBUTES))
+
+        msg = ldb.Message(dn)
+        if len(res):
+            msg["@IDXATTR"] = ldb.MessageElement(attrs, ldb.FLAG_MOD_REPLACE, "@IDXATTR")
+            self.ldb.modify(msg)
+        else:
+            msg["@IDXATTR"] = ldb.MessageElement(attrs, ldb.FLAG_MOD_ADD, "@IDXATTR")
+            self.ldb.add(msg)
+        self.reopen()
+        return attrs
+
     def add_rootDSE(self, ocserverdn, firstorg, firstou):
         self.ldb.add({"dn": "@ROOTDSE",
                       "defaultNamingContext": "CN=%s,CN=%s,%s" % (firstou, firstorg, ocserverdn),
@@ -331,17 +381,22 @@ class MysqlBackendMixin(object):
 
         return (conn_url.hostname, conn_url.username, passwd, conn_url.path.strip('/'), port)
 
-    def migrate(self, version=None):
+    def migrate(self, version=None, online=False, rows_per_second=None):
         """Migrate both mysql schema and data
 
         :param int version: indicating which version to migrate. None migrates
                             to the lastest version.
+        :param bool online: alter tables through a shadow table copied in
+                            batches instead of locking them
+        :param int rows_per_second: rows copied per second by online
+                                    alterations, 0 for no limit
         :rtype bool:
         :returns: True if any migration has been performed
         """
         self.db.select_db(self.db_name)
         migration_manager = MigrationManager(self.db, self.db_name)
-        return migration_manager.migrate(self.migration_app, version)
+        return migration_manager.migrate(self.migration_app, version,
+                                         online=online, rows_per_second=rows_per_second)
 
     def list_migrations(self):
         """List migrations metadata
@@ -512,6 +567,203 @@ class OpenChangeDBWithMysqlBackend(MysqlBackendMixin):
                       (value, self.server_id))
         self._change_number = value
 
+    def lookup_organization(self, firstorg, firstou):
+        """Load the organizational unit and server ids of an existing
+        organization, as add_server() sets them on a new one."""
+        self.db.select_db(self.db_name)
+        cur = self._execute(
+            "SELECT ou.id, s.id FROM organizational_units ou "
+            "JOIN servers s ON s.ou_id = ou.id "
+            "WHERE ou.organization = %s AND ou.administrative_group = %s",
+            (firstorg, firstou))
+        row = cur.fetchone()
+        if row is None:
+            raise NoSuchServer("%s/%s" % (firstorg, firstou))
+        self.ou_id, self.server_id = int(row[0]), int(row[1])
+
+    def _reserve_change_numbers(self, count):
+        # Same counter as reserve_server_change_numbers() in the server
+        cur = self._execute(
+            "UPDATE servers SET change_number = LAST_INSERT_ID(change_number + %s) "
+            "WHERE id = %s", (count, self.server_id))
+        cur = self._execute("SELECT LAST_INSERT_ID()")
+        self._change_number = None
+        return int(cur.fetchone()[0]) - count
+
+    def _folder_names(self, locale):
+        cur = self.db.cursor(MySQLdb.cursors.DictCursor)
+        try:
+            cur.execute("SELECT * FROM provisioning_folders WHERE locale IN (%s, 'en') "
+                        "ORDER BY locale = 'en'", (locale,))
+            return cur.fetchone()
+        finally:
+            cur.close()
+
+    def add_mailboxes(self, usernames, indexing, locale="en"):
+        """Create the mailboxes of several users in a single transaction.
+
+        The mailbox root, its search folders and the Top of Information
+        Store are inserted with one multi-row INSERT per table. The folders
+        stored in a mapistore backend are left to the provisioning done at
+        the first logon of each user, which skips what already exists.
+
+        :param usernames: users to create a mailbox for, the existing
+                          mailboxes are skipped
+        :param indexing: IndexingWithMysqlBackend the folder ids are
+                         allocated from
+        :param locale: locale of the folder names
+        :returns: the number of mailboxes created
+        """
+        if self.ou_id is None:
+            raise Exception("You have to call add_server or lookup_organization before calling add_mailboxes method")
+
+        self.db.select_db(self.db_name)
+        cur = self._execute("SELECT name FROM mailboxes WHERE ou_id = %s AND name IN " +
+                            _in_clause(usernames), tuple([self.ou_id] + list(usernames)))
+        existing = set(row[0] for row in cur.fetchall())
+        usernames = [u for u in usernames if u not in existing]
+        if not usernames:
+            return 0
+
+        # Ids are reserved outside the transaction below, like the server
+        # does, a failed chunk only leaves a gap in the counters
+        first_fmid = indexing.allocate_fmids(dict((u, _MAILBOX_BULK_IDS) for u in usernames))
+        first_cn = self._reserve_change_numbers(_MAILBOX_BULK_IDS * len(usernames))
+        folder_names = self._folder_names(locale)
+        nttime = str(samba.unix2nttime(int(time.time())))
+
+        mailboxes = []
+        folders = []
+        for i, username in enumerate(usernames):
+            fids = [int(gen_mailbox_folder_fid(first_fmid[username] + j, self.replica_id))
+                    for j in xrange(_MAILBOX_BULK_IDS)]
+            cns = [gen_mailbox_folder_fid(first_cn + i * _MAILBOX_BULK_IDS + j, self.replica_id)
+                   for j in xrange(_MAILBOX_BULK_IDS)]
+            mailboxes.append((username, fids[0], cns[0]))
+            for j, (system_idx, column, container_class) in enumerate(_MAILBOX_SEARCH_FOLDERS):
+                folders.append((username, fids[j + 1], cns[j + 1], system_idx,
+                                [("PidTagDisplayName", folder_names[column]),
+                                 ("PidTagContainerClass", container_class),
+                                 ("PidTagFolderType", "2")]))
+            folders.append((username, fids[-1], cns[-1], TOP_INFORMATION_STORE_SYSTEMIDX,
+                            [("PidTagDisplayName", folder_names["top_info_store"]),
+                             ("PidTagSubFolders", "TRUE")]))
+
+        cur = self.db.cursor()
+        try:
+            cur.executemany(
+                "INSERT INTO mailboxes (ou_id, folder_id, name, MailboxGUID, ReplicaGUID, "
+                "ReplicaID, SystemIdx, locale) VALUES (%s, %s, %s, %s, %s, %s, %s, %s)",
+                [(self.ou_id, fid, username, str(uuid.uuid4()), str(uuid.uuid4()),
+                  self.replica_id, MAILBOX_ROOT_SYSTEMIDX, locale)
+                 for username, fid, cn in mailboxes])
+            cur.execute("SELECT name, id FROM mailboxes WHERE ou_id = %s AND name IN " +
+                        _in_clause(usernames), tuple([self.ou_id] + usernames))
+            mailbox_ids = dict(cur.fetchall())
+
+            # Same properties as create_mailbox() and set_ReceiveFolder() in the server
+            properties = []
+            for username, fid, cn in mailboxes:
+                mailbox_id = mailbox_ids[username]
+                properties += [(mailbox_id, "PidTagAccess", "63"),
+                               (mailbox_id, "PidTagRights", "2043"),
+                               (mailbox_id, "PidTagFolderType", "1"),
+                               (mailbox_id, "PidTagSubFolders", "TRUE"),
+                               (mailbox_id, "PidTagDisplayName", "OpenChange: %s" % username),
+                               (mailbox_id, "PidTagCreationTime", nttime),
+                               (mailbox_id, "PidTagLastModificationTime", nttime),
+                               (mailbox_id, "PidTagChangeNumber", cn),
+                               (mailbox_id, "PidTagMessageClass", "IPC")]
+            cur.executemany("INSERT INTO mailboxes_properties VALUES (%s, %s, %s)",
+                            properties)
+
+            cur.executemany(
+                "INSERT INTO folders (ou_id, folder_id, folder_class, mailbox_id, "
+                "parent_folder_id, FolderType, SystemIdx, MAPIStoreURI) "
+                "VALUES (%s, %s, 'system', %s, NULL, 1, %s, NULL)",
+                [(self.ou_id, fid, mailbox_ids[username], system_idx)
+                 for username, fid, cn, system_idx, props in folders])
+            cur.execute("SELECT folder_id, id FROM folders WHERE mailbox_id IN " +
+                        _in_clause(mailbox_ids), tuple(mailbox_ids.values()))
+            folder_ids = dict((int(fid), id) for fid, id in cur.fetchall())
+
+            # Same properties as create_folder() in the server
+            properties = []
+            for username, fid, cn, system_idx, props in folders:
+                folder_id = folder_ids[fid]
+                props = [("PidTagContentUnreadCount", "0"),
+                         ("PidTagContentCount", "0"),
+                         ("PidTagAttributeHidden", "0"),
+                         ("PidTagAttributeSystem", "0"),
+                         ("PidTagAttributeReadOnly", "0"),
+                         ("PidTagAccess", "63"),
+                         ("PidTagRights", "2043"),
+                         ("PidTagCreationTime", nttime),
+                         ("PidTagChangeNumber", cn)] + props
+                properties += [(folder_id,) + p for p in props]
+            cur.executemany("INSERT INTO folders_properties VALUES (%s, %s, %s)",
+                            properties)
+            self.db.commit()
+        except:
+            self.db.rollback()
+            raise
+        finally:
+            cur.close()
+
+        return len(usernames)
+
+
+def _add_mailboxes_worker(args):
+    url, indexing_url, firstorg, firstou, usernames, locale = args
+    openchangedb = OpenChangeDBWithMysqlBackend(url)
+    openchangedb.lookup_organization(firstorg, firstou)
+    created = openchangedb.add_mailboxes(usernames, IndexingWithMysqlBackend(indexing_url), locale)
+    return len(usernames), created
+
+
+def add_mailboxes(url, indexing_url, names, usernames, locale="en",
+                  chunk_size=500, workers=1, report=None):
+    """Create the mailboxes of many users in a MySQL OpenChange database.
+
+    Users are split into chunks of chunk_size, each created in its own
+    transaction by OpenChangeDBWithMysqlBackend.add_mailboxes(). With more
+    than one worker, chunks are created in parallel by as many processes,
+    each with its own connections.
+
+    :param report: callable taking the number of users processed, the
+                   number of mailboxes created and the total of users,
+                   called after each chunk
+    :returns: the number of mailboxes created
+    """
+    usernames = sorted(set(usernames))
+    chunks = [(url, indexing_url, names.firstorg, names.firstou, chunk, locale)
+              for chunk in _chunks(usernames, chunk_size)]
+    total = len(usernames)
+    processed = 0
+    created = 0
+
+    if workers > 1 and len(chunks) > 1:
+        import multiprocessing
+        pool = multiprocessing.Pool(min(workers, len(chunks)))
+        try:
+            for count, chunk_created in pool.imap_unordered(_add_mailboxes_worker, chunks):
+                processed += count
+                created += chunk_created
+                if report:
+                    report(processed, created, total)
+        finally:
+            pool.close()
+            pool.join()
+    else:
+        for chunk in chunks:
+            count, chunk_created = _add_mailboxes_worker(chunk)
+            processed += count
+            created += chunk_created
+            if report:
+                report(processed, created, total)
+
+    return created
+
 
 OpenChangeDB = OpenChangeDBWithLdbBackend
 
@@ -542,6 +794,43 @@ class IndexingWithMysqlBackend(MysqlBackendMixin):
         self._connect_to_mysql()
         self.migration_app = 'indexing'
 
+    def allocate_fmids(self, counts):
+        """Reserve folder and message ids for several users at once.
+
+        Same counter as mysql_record_allocate_fmids() in mapistore.
+
+        :param dict counts: number of ids to reserve, indexed by username
+        :rtype dict:
+        :returns: the first id reserved, indexed by username
+        """
+        self.db.select_db(self.db_name)
+        usernames = counts.keys()
+        first = {}
+        cur = self.db.cursor()
+        try:
+            cur.execute("SELECT username, next_fmid FROM mapistore_indexes "
+                        "WHERE username IN " + _in_clause(usernames) + " FOR UPDATE",
+                        tuple(usernames))
+            for username, next_fmid in cur.fetchall():
+                first[username] = max(int(next_fmid), MAX_PUBLIC_FOLDER_ID + 1)
+                cur.execute("UPDATE mapistore_indexes SET next_fmid = %s WHERE username = %s",
+                            (first[username] + counts[username], username))
+
+            new_usernames = [u for u in usernames if u not in first]
+            for username in new_usernames:
+                first[username] = MAX_PUBLIC_FOLDER_ID + 1
+            if new_usernames:
+                cur.executemany("INSERT INTO mapistore_indexes (username, next_fmid) VALUES (%s, %s)",
+                                [(u, first[u] + counts[u]) for u in new_usernames])
+            self.db.commit()
+        except:
+            self.db.rollback()
+            raise
+        finally:
+            cur.close()
+
+        return first
+
 
 class NamedPropertiesWithMysqlBackend(MysqlBackendMixin):
     """The MAPIStore named properties database in MySQL backend."""
@@ -21,10 +21,17 @@
 Schema migration management for OpenChange "apps" with SQL based backends
 """
 import MySQLdb
+import sys
+import time
 
 
 __docformat__ = 'restructuredText'
 
+# Rows copied per second by online table alterations unless told otherwise
+ONLINE_ROWS_PER_SECOND = 5000
+# Rows copied in each transaction of an online table alteration
+ONLINE_BATCH_SIZE = 1000
+
 
 class MigrationManager(object):
 
@@ -261,12 +268,149 @@ def migration(app, version):
     return register_migration
 
 
+def _online_primary_key(cur, table):
+    """Return the primary key column of table when online alterations
+    are possible on it, otherwise None.
+
+    It must be a single integer column and no foreign key may point from
+    or to the table: the shadow table would lose them.
+    """
+    cur.execute("""SELECT k.COLUMN_NAME, c.DATA_TYPE
+                   FROM information_schema.KEY_COLUMN_USAGE k
+                   JOIN information_schema.COLUMNS c
+                     ON c.TABLE_SCHEMA = k.TABLE_SCHEMA AND c.TABLE_NAME = k.TABLE_NAME
+                    AND c.COLUMN_NAME = k.COLUMN_NAME
+                   WHERE k.TABLE_SCHEMA = DATABASE() AND k.TABLE_NAME = %s
+                     AND k.CONSTRAINT_NAME = 'PRIMARY'""", (table,))
+    rows = cur.fetchall()
+    if len(rows) != 1 or rows[0][1].lower() not in ('tinyint', 'smallint', 'mediumint', 'int', 'bigint'):
+        return None
+
+    cur.execute("""SELECT COUNT(*) FROM information_schema.KEY_COLUMN_USAGE
+                   WHERE TABLE_SCHEMA = DATABASE() AND REFERENCED_TABLE_NAME IS NOT NULL
+                     AND (TABLE_NAME = %s OR REFERENCED_TABLE_NAME = %s)""", (table, table))
+    if cur.fetchone()[0]:
+        return None
+
+    return rows[0][0]
+
+
+def _online_cleanup(cur, table):
+    """Drop the triggers and tables left by an online alteration of table"""
+    for event in ('ins', 'upd', 'del'):
+        cur.execute("DROP TRIGGER IF EXISTS `_{0}_online_{1}`".format(table, event))
+    cur.execute("DROP TABLE IF EXISTS `_{0}_new`".format(table))
+    cur.execute("DROP TABLE IF EXISTS `_{0}_old`".format(table))
+
+
+def online_alter_table(cur, table, alter, rows_per_second=None, batch_size=ONLINE_BATCH_SIZE):
+    """Alter a table without locking it for the length of the copy.
+
+    The alteration is applied to an empty copy of the table, called the
+    shadow table. Triggers replay on the shadow table the writes made to
+    the table meanwhile. The rows are copied in batches, each in its own
+    transaction, at most rows_per_second rows per second. The shadow
+    table then replaces the table with an atomic rename.
+
+    An interrupted alteration leaves the table untouched and is started
+    over when run again.
+
+    :param cur: the DB cursor
+    :param str table: the table to alter
+    :param str alter: what follows ALTER TABLE `table`
+    :param int rows_per_second: rows copied per second, 0 for no limit
+    :param int batch_size: rows copied per transaction
+    :raises ValueError: if the table cannot be altered online
+    """
+    if rows_per_second is None:
+        rows_per_second = ONLINE_ROWS_PER_SECOND
+    db = cur.connection
+    shadow = '_{0}_new'.format(table)
+
+    pk = _online_primary_key(cur, table)
+    if pk is None:
+        raise ValueError("%s cannot be altered online: it needs an integer primary key "
+                         "and no foreign keys" % table)
+
+    _online_cleanup(cur, table)
+    cur.execute("CREATE TABLE `{0}` LIKE `{1}`".format(shadow, table))
+    cur.execute("ALTER TABLE `{0}` {1}".format(shadow, alter))
+
+    cur.execute("""SELECT a.COLUMN_NAME FROM information_schema.COLUMNS a
+                   JOIN information_schema.COLUMNS b
+                     ON b.TABLE_SCHEMA = a.TABLE_SCHEMA AND b.COLUMN_NAME = a.COLUMN_NAME
+                   WHERE a.TABLE_SCHEMA = DATABASE() AND a.TABLE_NAME = %s AND b.TABLE_NAME = %s
+                   ORDER BY a.ORDINAL_POSITION""", (table, shadow))
+    columns = [row[0] for row in cur.fetchall()]
+    if pk not in columns:
+        _online_cleanup(cur, table)
+        raise ValueError("%s cannot be altered online: the alteration drops %s" % (table, pk))
+    names = ', '.join('`%s`' % c for c in columns)
+    new_values = ', '.join('NEW.`%s`' % c for c in columns)
+
+    try:
+        cur.execute("""CREATE TRIGGER `_{0}_online_ins` AFTER INSERT ON `{0}` FOR EACH ROW
+                       REPLACE INTO `{1}` ({2}) VALUES ({3})""".format(table, shadow, names, new_values))
+        cur.execute("""CREATE TRIGGER `_{0}_online_upd` AFTER UPDATE ON `{0}` FOR EACH ROW
+                       BEGIN
+                         DELETE FROM `{1}` WHERE `{4}` = OLD.`{4}`;
+                         REPLACE INTO `{1}` ({2}) VALUES ({3});
+                       END""".format(table, shadow, names, new_values, pk))
+        cur.execute("""CREATE TRIGGER `_{0}_online_del` AFTER DELETE ON `{0}` FOR EACH ROW
+                       DELETE FROM `{1}` WHERE `{2}` = OLD.`{2}`""".format(table, shadow, pk))
+
+        # Rows written from now on are copied by the triggers
+        cur.execute("SELECT MIN(`{0}`), MAX(`{0}`) FROM `{1}`".format(pk, table))
+        low, high = cur.fetchone()
+        copied = 0
+        started = time.time()
+        while low is not None and low <= high:
+            cur.execute("""INSERT IGNORE INTO `{0}` ({1})
+                           SELECT {1} FROM `{2}` WHERE `{3}` >= %s AND `{3}` < %s
+                           LOCK IN SHARE MODE""".format(shadow, names, table, pk),
+                        (low, low + batch_size))
+            db.commit()
+            copied += cur.rowcount
+            low += batch_size
+            if rows_per_second > 0:
+                delay = started + float(copied) / rows_per_second - time.time()
+                if delay > 0:
+                    time.sleep(delay)
+
+        cur.execute("RENAME TABLE `{0}` TO `_{0}_old`, `{1}` TO `{0}`".format(table, shadow))
+    except:
+        db.rollback()
+        _online_cleanup(cur, table)
+        raise
+
+    _online_cleanup(cur, table)
+
+
 class Migration(object):
     """Base migration class to implement the migration interface called by
        migration manager
     """
     description = 'migration'
 
+    @classmethod
+    def alter_table(cls, cur, table, alter, **kwargs):
+        """Alter a table, online when the migration is run with online=True
+
+        Tables online_alter_table() cannot handle are altered in place.
+
+        :param cur: the DB cursor
+        :param str table: the table to alter
+        :param str alter: what follows ALTER TABLE `table`
+        :param bool online: use online_alter_table()
+        :param int rows_per_second: rows copied per second when online
+        """
+        if kwargs.get('online'):
+            if _online_primary_key(cur, table) is not None:
+                online_alter_table(cur, table, alter, kwargs.get('rows_per_second'))
+                return
+            sys.stderr.write("%s cannot be altered online, altering it in place\n" % table)
+        cur.execute("ALTER TABLE `{0}` {1}".format(table, alter))
+
     @classmethod
     def apply(cls, cur, **kwargs):
         """Apply this migration
@@ -276,7 +420,7 @@ class Migration(object):
         pass
 
     @classmethod
-    def unapply(cls, cur):
+    def unapply(cls, cur, **kwargs):
         """Unapply this migration
 
         :param cur: the DB cursor
@@ -56,7 +56,7 @@ class InitialIndexingMigration(Migration):
                        ENGINE = InnoDB""")
 
     @classmethod
-    def unapply(cls, cur):
+    def unapply(cls, cur, **kwargs):
         for query in ("DROP TABLE mapistore_indexes",
                       "DROP TABLE mapistore_indexing"):
             cur.execute(query)
@@ -69,14 +69,44 @@ class IndexesMigration(Migration):
 
     @classmethod
     def apply(cls, cur, **kwargs):
-        cur.execute("CREATE INDEX `mapistore_indexing_username_idx` ON `mapistore_indexing` (`username`(255) ASC)")
-        cur.execute("CREATE INDEX `mapistore_indexing_username_url_idx` ON `mapistore_indexing` (`username`(255) ASC, `url`(255) ASC)")
-        cur.execute("CREATE INDEX `mapistore_indexing_username_fmid_idx` ON `mapistore_indexing` (`username`(255) ASC, `fmid` ASC)")
-        cur.execute("CREATE INDEX `mapistore_indexes_username_idx` ON `mapistore_indexes` (`username`(255) ASC)")
+        cls.alter_table(cur, 'mapistore_indexing',
+                        """ADD INDEX `mapistore_indexing_username_idx` (`username`(255) ASC),
+                           ADD INDEX `mapistore_indexing_username_url_idx` (`username`(255) ASC, `url`(255) ASC),
+                           ADD INDEX `mapistore_indexing_username_fmid_idx` (`username`(255) ASC, `fmid` ASC)""",
+                        **kwargs)
+        cls.alter_table(cur, 'mapistore_indexes',
+                        "ADD INDEX `mapistore_indexes_username_idx` (`username`(255) ASC)",
+                        **kwargs)
 
     @classmethod
-    def unapply(cls, cur):
-        cur.execute("DROP INDEX `mapistore_indexing_username_idx` ON `mapistore_indexing`")
-        cur.execute("DROP INDEX `mapistore_indexing_username_url_idx` ON `mapistore_indexing`")
-        cur.execute("DROP INDEX `mapistore_indexing_username_fmid_idx` ON `mapistore_indexing`")
-        cur.execute("DROP INDEX `mapistore_indexes_username_idx` ON `mapistore_indexes`")
+    def unapply(cls, cur, **kwargs):
+        cls.alter_table(cur, 'mapistore_indexing',
+                        """DROP INDEX `mapistore_indexing_username_idx`,
+                           DROP INDEX `mapistore_indexing_username_url_idx`,
+                           DROP INDEX `mapistore_indexing_username_fmid_idx`""",
+                        **kwargs)
+        cls.alter_table(cur, 'mapistore_indexes',
+                        "DROP INDEX `mapistore_indexes_username_idx`",
+                        **kwargs)
+
+
+@migration('indexing', 3)
+class ReplicaMappingMigration(Migration):
+
+    description = 'Replica GUID to replica ID mappings'
+
+    @classmethod
+    def apply(cls, cur, **kwargs):
+        cur.execute("""CREATE TABLE IF NOT EXISTS `mapistore_replica_mapping` (
+                         `id` INT NOT NULL AUTO_INCREMENT,
+                         `username` VARCHAR(1024) NOT NULL,
+                         `replid` SMALLINT UNSIGNED NOT NULL,
+                         `guid` VARCHAR(36) NOT NULL,
+                         PRIMARY KEY (`id`),
+                         UNIQUE KEY `mapistore_replica_mapping_replid_idx` (`username`(255), `replid`),
+                         UNIQUE KEY `mapistore_replica_mapping_guid_idx` (`username`(255), `guid`))
+                       ENGINE = InnoDB""")
+
+    @classmethod
+    def unapply(cls, cur, **kwargs):
+        cur.execute("DROP TABLE mapistore_replica_mapping")
@@ -59,7 +59,7 @@ class InitialIndexingMigration(Migration):
                       ) ENGINE=InnoDB CHARSET=utf8""")
 
     @classmethod
-    def unapply(cls, cur):
+    def unapply(cls, cur, **kwargs):
         cur.execute("DROP TABLE named_properties")
 
 
@@ -123,5 +123,5 @@ class InitialDataMigration(Migration):
         cur.execute(sql)
 
     @classmethod
-    def unapply(cls, cur):
+    def unapply(cls, cur, **kwargs):
         cur.execute("DELETE FROM named_properties")
@@ -226,7 +226,7 @@ class InitialOCDBMigration(Migration):
         cur.execute("""INSERT INTO `provisioning_special_folders` SET locale = 'en'""")
 
     @classmethod
-    def unapply(cls, cur):
+    def unapply(cls, cur, **kwargs):
         for query in ("DROP TABLE provisioning_special_folders",
                       "DROP TABLE provisioning_folders",
                       "DROP TABLE servers",
@@ -239,3 +239,79 @@ class InitialOCDBMigration(Migration):
                       "DROP TABLE public_folders",
                       "DROP TABLE organizational_units"):
             cur.execute(query)
+
+
+@migration('openchangedb', 2)
+class FolderCountsMigration(Migration):
+
+    description = 'Recursive folder counts'
+
+    @classmethod
+    def apply(cls, cur, **kwargs):
+        cur.execute("""CREATE TABLE IF NOT EXISTS `folder_counts` (
+                         `mailbox_id` BIGINT UNSIGNED NOT NULL,
+                         `folder_id` BIGINT UNSIGNED NOT NULL,
+                         `recursive_count` INT UNSIGNED NOT NULL,
+                         PRIMARY KEY (`mailbox_id`, `folder_id`),
+                         CONSTRAINT `fk_folder_counts_mailbox_id`
+                           FOREIGN KEY (`mailbox_id`)
+                           REFERENCES `mailboxes` (`id`)
+                           ON DELETE CASCADE
+                           ON UPDATE CASCADE)
+                       ENGINE = InnoDB""")
+
+    @classmethod
+    def unapply(cls, cur, **kwargs):
+        cur.execute("DROP TABLE folder_counts")
+
+
+@migration('openchangedb', 3)
+class FolderChangeNumbersMigration(Migration):
+
+    description = 'Hierarchy change numbers'
+
+    @classmethod
+    def apply(cls, cur, **kwargs):
+        cur.execute("""CREATE TABLE IF NOT EXISTS `folder_change_numbers` (
+                         `mailbox_id` BIGINT UNSIGNED NOT NULL,
+                         `folder_id` BIGINT UNSIGNED NOT NULL,
+                         `change_number` BIGINT UNSIGNED NOT NULL,
+                         PRIMARY KEY (`mailbox_id`, `folder_id`),
+                         CONSTRAINT `fk_folder_change_numbers_mailbox_id`
+                           FOREIGN KEY (`mailbox_id`)
+                           REFERENCES `mailboxes` (`id`)
+                           ON DELETE CASCADE
+                           ON UPDATE CASCADE)
+                       ENGINE = InnoDB""")
+
+    @classmethod
+    def unapply(cls, cur, **kwargs):
+        cur.execute("DROP TABLE folder_change_numbers")
+
+
+@migration('openchangedb', 4)
+class FolderMessageCountsMigration(Migration):
+
+    description = 'Folder message counters'
+
+    @classmethod
+    def apply(cls, cur, **kwargs):
+        cur.execute("""CREATE TABLE IF NOT EXISTS `folder_message_counts` (
+                         `mailbox_id` BIGINT UNSIGNED NOT NULL,
+                         `folder_id` BIGINT UNSIGNED NOT NULL,
+                         `messages` BIGINT NOT NULL,
+                         `fai` BIGINT NOT NULL,
+                         `unread` BIGINT NOT NULL,
+                         `size` BIGINT NOT NULL,
+                         `refreshed` DATETIME NOT NULL,
+                         PRIMARY KEY (`mailbox_id`, `folder_id`),
+                         CONSTRAINT `fk_folder_message_counts_mailbox_id`
+                           FOREIGN KEY (`mailbox_id`)
+                           REFERENCES `mailboxes` (`id`)
+                           ON DELETE CASCADE
+                           ON UPDATE CASCADE)
+                       ENGINE = InnoDB""")
+
+    @classmethod
+    def unapply(cls, cur, **kwargs):
+        cur.execute("DROP TABLE folder_message_counts")
@@ -1261,12 +1261,12 @@ def directory_fake_migration(lp, uri, target_version):
         print "Only OpenchangeDB with MySQL as backend has migration capability"
 
 
-def openchangedb_migrate(lp, uri=None, version=None):
+def openchangedb_migrate(lp, uri=None, version=None, online=False, rows_per_second=None):
     if uri is None:
         uri = openchangedb_url(lp)
     if uri.startswith('mysql:'):
         openchangedb = mailbox.OpenChangeDBWithMysqlBackend(uri)
-        if openchangedb.migrate(version):
+        if openchangedb.migrate(version, online, rows_per_second):
             print "Migration openchange db done"
         else:
             print "Nothing to migrate"
@@ -1285,6 +1285,34 @@ def openchangedb_list_migrations(lp, uri):
         print "Only OpenchangeDB with MySQL as backend has migration capability"
 
 
+def openchangedb_migrate_from_ldb(lp, ldb_uri, uri=None, workers=1):
+    """Copy an OpenChange database from the LDB backend to MySQL.
+
+    Interrupted copies resume where they stopped when run again.
+
+    :param lp: Loadparm context
+    :param ldb_uri: Path of the openchange.ldb file
+    :param uri: MySQL destination, it defaults to the one set in the conf file
+    :param workers: Number of processes copying mailboxes in parallel
+    """
+    from openchange import ldb_to_mysql
+
+    if uri is None:
+        uri = openchangedb_url(lp)
+    if not uri.startswith('mysql:'):
+        print "[!] The destination of the copy must be a MySQL openchangedb"
+        return
+
+    openchangedb = mailbox.OpenChangeDBWithMysqlBackend(uri)
+    openchangedb.migrate()
+
+    def report(copied, total):
+        print "\t* %d/%d shards copied" % (copied, total)
+
+    copied = ldb_to_mysql.migrate(ldb_uri, uri, workers, report)
+    print "[+] OpenChange DB copied from %s (%d shards this run)" % (ldb_uri, copied)
+
+
 def openchangedb_fake_migration(lp, uri, target_version):
     if uri is None:
         uri = openchangedb_url(lp)
@@ -1318,6 +1346,21 @@ def openchangedb_provision(names, lp, uri):
     openchangedb.add_public_folders(names)
 
 
+def openchangedb_reindex(lp):
+    """Index the attributes searched by the server in an existing LDB
+    OpenChange database.
+
+    :param lp: Loadparm context
+    """
+    uri = openchangedb_url(lp)
+    if not (uri.startswith('ldb:') or uri.startswith('/')):
+        print "Only OpenchangeDB with LDB as backend needs to be reindexed"
+        return
+    openchangedb = mailbox.OpenChangeDB(uri)
+    attrs = openchangedb.reindex()
+    print "OpenChange database indexed on %s" % ", ".join(attrs)
+
+
 def openchangedb_new_organization(names, lp):
     """Create organization, servers and public folders in openchange db
 
@@ -1334,6 +1377,34 @@ def openchangedb_new_organization(names, lp):
     openchangedb.add_public_folders(names)
 
 
+def openchangedb_new_mailboxes(names, lp, usernames, locale="en",
+                               chunk_size=500, workers=1):
+    """Create the mailboxes of many users ahead of their first logon.
+
+    :param names: Provision names object
+    :param lp: Loadparm context
+    :param usernames: Users to create a mailbox for
+    :param locale: Locale of the folder names
+    :param chunk_size: Number of mailboxes created per transaction
+    :param workers: Number of processes creating chunks in parallel
+    """
+    uri = openchangedb_url(lp)
+    if not uri.startswith('mysql:'):
+        print "Only OpenchangeDB with MySQL as backend supports bulk mailbox provisioning"
+        return
+    if not indexing_url(lp).startswith('mysql:'):
+        print "Bulk mailbox provisioning requires MAPIStore indexing with MySQL as backend"
+        return
+
+    def report(processed, created, total):
+        print "\t* %d/%d users processed, %d mailboxes created" % (processed, total, created)
+
+    usernames = set(usernames)
+    count = mailbox.add_mailboxes(uri, indexing_url(lp), names, usernames,
+                                  locale, chunk_size, workers, report)
+    print "[+] %d mailboxes created, %d already existed" % (count, len(usernames) - count)
+
+
 def find_setup_dir():
     """Find the setup directory used by provision."""
     dirname = os.path.dirname(__file__)
@@ -1370,12 +1441,12 @@ def check_not_provisioned(names, lp, creds):
 
 
 # Indexing related procedures
-def indexing_migrate(lp, uri=None, version=None):
+def indexing_migrate(lp, uri=None, version=None, online=False, rows_per_second=None):
     if uri is None:
         uri = indexing_url(lp)
     if uri.startswith('mysql:'):
         indexing = mailbox.IndexingWithMysqlBackend(uri)
-        if indexing.migrate(version):
+        if indexing.migrate(version, online, rows_per_second):
             print "Migration MAPIStore indexing backend done"
         else:
             print "Nothing to migrate"
@@ -1406,12 +1477,12 @@ def indexing_fake_migration(lp, uri, target_version):
 
 
 # Named properties related procedures
-def named_props_migrate(lp, uri=None, version=None):
+def named_props_migrate(lp, uri=None, version=None, online=False, rows_per_second=None):
     if uri is None:
         uri = named_properties_url(lp)
     if uri.startswith('mysql:'):
         named_properties = mailbox.NamedPropertiesWithMysqlBackend(uri)
-        if named_properties.migrate(version):
+        if named_properties.migrate(version, online, rows_per_second):
             print "Migration MAPIStore named properties backend done"
         else:
             print "Nothing to migrate"
@@ -0,0 +1,109 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+
+# OpenChange mailbox to node affinity
+# Copyright (C) OpenChange Project 2015
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""Consistent hashing of mailbox owners over the OpenChange nodes.
+
+This is the ring mapiproxy builds from mapiproxy:shard_nodes
+(mapiproxy/libmapiproxy/shard.c), so the web services send clients to
+the node that serves their mailbox. Both implementations must be kept
+in sync.
+"""
+
+import bisect
+import re
+
+DEFAULT_VNODES = 64
+
+
+def shard_hash(value):
+    """Hash a string in a case insensitive way: FNV-1a over the lower
+    case bytes, followed by the murmur3 finalizer."""
+    if isinstance(value, unicode):
+        value = value.encode('utf-8')
+    h = 2166136261
+    for c in value.lower():
+        h = ((h ^ ord(c)) * 16777619) & 0xffffffff
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    return h
+
+
+class ShardRing(object):
+    """Ring of the nodes mailboxes are spread over."""
+
+    def __init__(self, nodes, vnodes=DEFAULT_VNODES, local=None):
+        if not nodes:
+            raise ValueError("A ring needs at least one node")
+        if vnodes <= 0:
+            raise ValueError("Invalid number of points per node: %d" % vnodes)
+        self.nodes = [node.lower() for node in nodes]
+        self.local = local.lower() if local else None
+        points = []
+        for (index, node) in enumerate(self.nodes):
+            for i in xrange(vnodes):
+                points.append((shard_hash("%s#%d" % (node, i)), index))
+        points.sort()
+        self._hashes = [point[0] for point in points]
+        self._nodes = [point[1] for point in points]
+
+    def __contains__(self, node):
+        return node is not None and node.lower() in self.nodes
+
+    def lookup(self, owner):
+        """Return the node the mailbox of owner belongs to."""
+        idx = bisect.bisect_left(self._hashes, shard_hash(owner))
+        if idx == len(self._hashes):
+            idx = 0
+        return self.nodes[self._nodes[idx]]
+
+    def is_local(self, owner):
+        """Return whether the mailbox of owner is served by this node."""
+        return self.local is None or self.lookup(owner) == self.local
+
+
+def load_ring(lp):
+    """Return the ring configured in smb.conf, or None when mailboxes
+    are not sharded.
+
+    :param lp: samba.param.LoadParm instance
+    """
+    nodes = lp.get("mapiproxy:shard_nodes")
+    if not nodes:
+        return None
+    if isinstance(nodes, basestring):
+        nodes = [node for node in re.split(r"[\s,;]+", nodes) if node]
+    if not nodes:
+        return None
+
+    vnodes = lp.get("mapiproxy:shard_vnodes")
+    try:
+        vnodes = int(vnodes) if vnodes else DEFAULT_VNODES
+    except ValueError:
+        vnodes = DEFAULT_VNODES
+    if vnodes <= 0:
+        vnodes = DEFAULT_VNODES
+
+    local = lp.get("mapiproxy:shard_node")
+    if not local:
+        local = "%s.%s" % (lp.get("netbios name"), lp.get("realm"))
+
+    return ShardRing(nodes, vnodes, local)
@@ -63,6 +63,13 @@ class OpenChangeDBTests(unittest.TestCase):
         self.db.add_server(self.names)
         self.assertEquals(1, self.db.get_message_ReplicaID(self.names.netbiosname))
 
+    def test_reindex(self):
+        attrs = self.db.reindex()
+        self.assertTrue("cn" in attrs)
+        self.assertTrue("PidTagFolderId" in attrs)
+        self.assertTrue("MAPIStoreURI" in attrs)
+        self.assertEquals(attrs, self.db.reindex())
+
 
 class MailboxFIDTests(unittest.TestCase):
 
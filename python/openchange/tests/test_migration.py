@@ -27,7 +27,7 @@ import unittest
 from warnings import filterwarnings
 
 
-from openchange.migration import migration, Migration, MigrationManager
+from openchange.migration import migration, Migration, MigrationManager, online_alter_table
 from samba import param
 
 
@@ -70,6 +70,7 @@ class MigrationDBTests(unittest.TestCase):
     def tearDown(self):
         cur = self.db.cursor()
         cur.execute('DROP TABLE IF EXISTS test_migrations')
+        cur.execute('DROP TABLE IF EXISTS test_online')
 
     def _register_do_nothing_migrations(self, app):
         # Register a do-nothing migration into app
@@ -223,3 +224,38 @@ class MigrationDBTests(unittest.TestCase):
 
         for v in manager.migrations.keys():
             del manager.migrations[v]
+
+    def test_online_alter_table(self):
+        cur = self.db.cursor()
+        cur.execute('DROP TABLE IF EXISTS test_online')
+        cur.execute("""CREATE TABLE test_online (
+                         id INT NOT NULL AUTO_INCREMENT,
+                         name VARCHAR(64) NOT NULL,
+                         PRIMARY KEY (id)) ENGINE = InnoDB""")
+        cur.executemany('INSERT INTO test_online (name) VALUES (%s)',
+                        [('row%d' % i,) for i in range(25)])
+        self.db.commit()
+
+        online_alter_table(cur, 'test_online',
+                           "ADD COLUMN `flags` INT NOT NULL DEFAULT 7, ADD INDEX `test_online_name_idx` (`name`)",
+                           rows_per_second=0, batch_size=10)
+
+        cur.execute('SELECT COUNT(*), MIN(flags), MAX(flags) FROM test_online')
+        self.assertEquals(cur.fetchone(), (25, 7, 7))
+        cur.execute("SHOW INDEX FROM test_online WHERE Key_name = 'test_online_name_idx'")
+        self.assertIsNotNone(cur.fetchone())
+        cur.execute("SHOW TABLES LIKE '\\_test\\_online\\_%'")
+        self.assertIsNone(cur.fetchone())
+        cur.execute("SHOW TRIGGERS LIKE 'test\\_online'")
+        self.assertIsNone(cur.fetchone())
+
+    def test_online_alter_table_without_primary_key(self):
+        cur = self.db.cursor()
+        cur.execute('DROP TABLE IF EXISTS test_online')
+        cur.execute('CREATE TABLE test_online (name VARCHAR(64) NOT NULL) ENGINE = InnoDB')
+
+        self.assertRaises(ValueError, online_alter_table, cur, 'test_online',
+                          'ADD COLUMN `flags` INT NULL')
+        Migration.alter_table(cur, 'test_online', 'ADD COLUMN `flags` INT NULL', online=True)
+        cur.execute("SHOW COLUMNS FROM test_online LIKE 'flags'")
+        self.assertIsNotNone(cur.fetchone())
@@ -0,0 +1,96 @@
+#!/usr/bin/python
+# -*- coding: utf-8 -*-
+
+# Copyright (C) OpenChange Project 2015
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Mailbox to node affinity tests.
+
+The expected values are shared with testsuite/libmapiproxy/shard.c, so
+the web services and mapiproxy agree on the node of every mailbox.
+"""
+import unittest
+
+from openchange.shard import ShardRing, load_ring, shard_hash
+
+NODES = ["Node1.example.com", "node2.example.com", "node3.example.com"]
+
+
+class FakeLoadParm(object):
+
+    def __init__(self, params):
+        self.params = params
+
+    def get(self, name):
+        return self.params.get(name)
+
+
+class ShardHashTests(unittest.TestCase):
+
+    def test_hash(self):
+        self.assertEqual(0xab3e7c0b, shard_hash(""))
+        self.assertEqual(0x1d6bcac2, shard_hash("jdoe"))
+        self.assertEqual(0x1d6bcac2, shard_hash("JDoe"))
+        self.assertEqual(0x79602f5d, shard_hash("node1.example.com#0"))
+
+
+class ShardRingTests(unittest.TestCase):
+
+    def test_lookup(self):
+        ring = ShardRing(NODES)
+        self.assertEqual("node3.example.com", ring.lookup("jdoe"))
+        self.assertEqual("node2.example.com", ring.lookup("alice"))
+        self.assertEqual("node1.example.com", ring.lookup("carol"))
+        self.assertEqual("node3.example.com", ring.lookup("JDOE"))
+
+    def test_add_node(self):
+        ring = ShardRing(NODES)
+        bigger = ShardRing(NODES + ["node4.example.com"])
+        for i in xrange(1000):
+            owner = "user%d" % i
+            if ring.lookup(owner) != bigger.lookup(owner):
+                self.assertEqual("node4.example.com", bigger.lookup(owner))
+
+    def test_membership(self):
+        ring = ShardRing(NODES, local="node3.example.com")
+        self.assertTrue("NODE1.example.com" in ring)
+        self.assertFalse("node4.example.com" in ring)
+        self.assertTrue(ring.is_local("jdoe"))
+        self.assertFalse(ring.is_local("alice"))
+
+    def test_invalid(self):
+        self.assertRaises(ValueError, ShardRing, [])
+        self.assertRaises(ValueError, ShardRing, NODES, 0)
+
+
+class LoadRingTests(unittest.TestCase):
+
+    def test_not_configured(self):
+        self.assertEqual(None, load_ring(FakeLoadParm({})))
+
+    def test_configured(self):
+        lp = FakeLoadParm({"mapiproxy:shard_nodes": "node1.example.com, node2.example.com",
+                           "netbios name": "NODE2",
+                           "realm": "EXAMPLE.COM"})
+        ring = load_ring(lp)
+        self.assertEqual(["node1.example.com", "node2.example.com"], ring.nodes)
+        self.assertEqual("node2.example.com", ring.local)
+
+    def test_list_value(self):
+        lp = FakeLoadParm({"mapiproxy:shard_nodes": ["node1.example.com", "node2.example.com"],
+                           "mapiproxy:shard_node": "node1.example.com"})
+        ring = load_ring(lp)
+        self.assertEqual("node1.example.com", ring.local)
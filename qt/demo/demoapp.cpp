@@ -3,6 +3,7 @@
 #include "demoapp.h"
 
 #include "../lib/foldermodel.h"
+#include "../lib/mapilock.h"
 #include "../lib/messagesmodel.h"
 
 #include <libmapi++/libmapi++.h>
@@ -21,7 +22,6 @@ DemoApp::DemoApp()
     
     addFolderDockWidget();
     addMessagesDockWidget();
-    openMessage( 0 );
       
     resize( 1100, 900 );
 }
@@ -68,8 +68,7 @@ void DemoApp::addFolderDockWidget()
 {
     m_folderDock = new QDockWidget( tr( "Folders" ), this );
     
-    FolderModel *folder = new FolderModel( m_mapi_session );
-    m_folderModel = folder->buildModel();
+    m_folderModel = new FolderModel( m_mapi_session, this );
     
     QTreeView *folderDockView = new QTreeView( m_folderDock );
     folderDockView->setModel( m_folderModel );
@@ -84,16 +83,19 @@ void DemoApp::addMessagesDockWidget()
 {
     QDockWidget *messagesDock = new QDockWidget( tr( "Messages" ), this );
     
-    // Get Default Inbox folder ID.
-    mapi_id_t inbox_id = m_mapi_session->get_message_store().get_default_folder(olFolderInbox);
-    // std::cout << "inbox_id: " << inbox_id << std::endl;
+    {
+	QMutexLocker locker( mapiLock() );
+
+	// Get Default Inbox folder ID.
+	mapi_id_t inbox_id = m_mapi_session->get_message_store().get_default_folder(olFolderInbox);
+	// std::cout << "inbox_id: " << inbox_id << std::endl;
+
+	// Open Inbox Folder
+	m_folder = new folder(m_mapi_session->get_message_store(), inbox_id);
+    }
 
-    // Open Inbox Folder
-    m_folder = new folder(m_mapi_session->get_message_store(), inbox_id);
-    MessagesModel *messages = new MessagesModel( m_folder );
-    
     m_messagesDockView = new QTableView( messagesDock );
-    m_messagesModel = messages->buildModel();
+    m_messagesModel = new MessagesModel( m_folder, this );
     m_messagesDockView->setModel( m_messagesModel );
     m_messagesDockView->setShowGrid( false );
     m_messagesDockView->resizeColumnsToContents();
@@ -109,29 +111,32 @@ void DemoApp::folderChanged(const QModelIndex &index)
     QStandardItem *item = m_folderModel->itemFromIndex( index );
     if (item) {
 	qlonglong folderId = item->data().toLongLong();
-	m_folder = new folder(m_mapi_session->get_message_store(), folderId);
-	MessagesModel *messages = new MessagesModel( m_folder );
-	m_messagesModel = messages->buildModel();
+	{
+	    QMutexLocker locker( mapiLock() );
+	    m_folder = new folder(m_mapi_session->get_message_store(), folderId);
+	}
+	MessagesModel *previous = m_messagesModel;
+	m_messagesModel = new MessagesModel( m_folder, this );
 	m_messagesDockView->setModel( m_messagesModel );
+	delete previous;
     }
 }
 
 void DemoApp::messageChanged( const QModelIndex &index )
 {
-    QStandardItem *item = m_messagesModel->itemFromIndex( index );
-    if ( item ) {
-	quint32 messageNumber = item->data().toUInt();
-	openMessage( messageNumber );
+    QVariant mid = m_messagesModel->data( index.sibling( index.row(), 0 ), Qt::UserRole );
+    if ( mid.isValid() ) {
+	openMessage( mid.toULongLong() );
     }
 }
 
-void DemoApp::openMessage( quint32 messageNumber )
+void DemoApp::openMessage( quint64 messageId )
 {
-    libmapipp::folder::message_container_type messages = m_folder->fetch_messages();
-    // std::cout << "Folder contains " << messages.size() << " messages" << std::endl;
+    QMutexLocker locker( mapiLock() );
 
     // Get the properties we are interested in
-    libmapipp::property_container msg_props = messages[messageNumber]->get_property_container();
+    libmapipp::message msg( *m_mapi_session, m_folder->get_id(), messageId );
+    libmapipp::property_container msg_props = msg.get_property_container();
     msg_props << PR_BODY_HTML;
     msg_props.fetch();
 
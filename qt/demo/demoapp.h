@@ -9,6 +9,8 @@ class QMenu;
 class QTextEdit;
 class QStandardItem;
 class QTableView;
+class FolderModel;
+class MessagesModel;
 
 namespace libmapipp
 {
@@ -37,7 +39,7 @@ class DemoApp : public QMainWindow
     void addFolderDockWidget();
     void addMessagesDockWidget();
     
-    void openMessage( quint32 messageNumber );
+    void openMessage( quint64 messageId );
 
     QMenu *m_fileMenu;
     QMenu *m_helpMenu;
@@ -46,10 +48,10 @@ class DemoApp : public QMainWindow
     QAction *m_aboutAction;
     
     QDockWidget *m_folderDock;
-    QStandardItemModel *m_folderModel;
+    FolderModel *m_folderModel;
     
     QTableView *m_messagesDockView;
-    QStandardItemModel *m_messagesModel;
+    MessagesModel *m_messagesModel;
     
     libmapipp::folder *m_folder;
     QTextEdit *m_textEdit;
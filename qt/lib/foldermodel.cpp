@@ -1,75 +1,208 @@
-#include <Qt/QtGui>
-#include <exception>
-#include <vector>
-#include <string>
-
+#include <QtCore/QMutexLocker>
 #include <QtCore/QStringList>
 #include <QtCore/QDebug>
+#include <exception>
+#include <iostream>
 
 #include "foldermodel.h"
+#include "mapilock.h"
 
 #include <libmapi++/libmapi++.h>
 
 using namespace libmapipp;
 
-FolderModel::FolderModel( libmapipp::session *mapi_session ) :
+static QString columnString( SRow *row, uint32_t property_tag )
+{
+    const char *value = static_cast<const char*>( find_SPropValue_data( row, property_tag ) );
+    return value ? QString::fromUtf8( value ) : QString();
+}
+
+FolderFetcher::FolderFetcher( libmapipp::session *mapi_session ) :
   m_mapi_session( mapi_session )
 {
-      m_folderModel = new QStandardItemModel();
-      QStringList folderModelHeaders;
-      folderModelHeaders << QString( "Folder Name" ) << QString( "FolderId" ) << QString( "Container Class" );
-      m_folderModel->setHorizontalHeaderLabels( folderModelHeaders );
 }
 
-void FolderModel::add_folder_to_tree(libmapipp::folder& up_folder, QStandardItem *parentItem)
+void FolderFetcher::fetchTop()
+{
+    QList<FolderRow> rows;
+
+    QMutexLocker locker( mapiLock() );
+    try {
+	// Get Default Top Information Store folder ID
+	mapi_id_t top_folder_id = m_mapi_session->get_message_store().get_default_folder(olFolderTopInformationStore);
+
+	// Open Top Information Folder
+	folder top_folder( m_mapi_session->get_message_store(), top_folder_id );
+
+	property_container top_folder_property_container = top_folder.get_property_container();
+	top_folder_property_container << PR_DISPLAY_NAME << PR_CONTAINER_CLASS << PR_FOLDER_CHILD_COUNT;
+	top_folder_property_container.fetch();
+
+	FolderRow row;
+	row.fid = top_folder_id;
+	row.displayName = QString::fromUtf8( static_cast<const char*>(top_folder_property_container[PR_DISPLAY_NAME]) );
+	if (top_folder_property_container[PR_CONTAINER_CLASS])
+	    row.containerClass = QString::fromUtf8( static_cast<const char*>(top_folder_property_container[PR_CONTAINER_CLASS]) );
+	row.childCount = top_folder_property_container[PR_FOLDER_CHILD_COUNT] ?
+	    *static_cast<const uint32_t*>(top_folder_property_container[PR_FOLDER_CHILD_COUNT]) : 1;
+	rows << row;
+    }
+    catch (mapi_exception e) // Catch any mapi exceptions
+    {
+	std::cout << "MAPI Exception @ FolderFetcher::fetchTop: " <<  e.what() << std::endl;
+    }
+
+    emit fetched( 0, rows );
+}
+
+void FolderFetcher::fetchChildren( quint64 fid )
+{
+    mapi_object_t	hierarchy_table;
+    uint32_t		count = 0;
+    SRowSet		row_set;
+
+    QMutexLocker locker( mapiLock() );
+    try {
+	folder up_folder( m_mapi_session->get_message_store(), fid );
+
+	mapi_object_init( &hierarchy_table );
+	if (GetHierarchyTable( &up_folder.data(), &hierarchy_table, 0, &count ) != MAPI_E_SUCCESS) {
+	    mapi_object_release( &hierarchy_table );
+	    throw mapi_exception( GetLastError(), "FolderFetcher::fetchChildren : GetHierarchyTable" );
+	}
+
+	// The child folders are not opened, their table row is enough
+	SPropTagArray *property_tag_array = set_SPropTagArray( m_mapi_session->get_memory_ctx(), 0x4, PR_FID,
+							       PR_DISPLAY_NAME, PR_CONTAINER_CLASS, PR_FOLDER_CHILD_COUNT );
+	if (SetColumns( &hierarchy_table, property_tag_array ) != MAPI_E_SUCCESS) {
+	    MAPIFreeBuffer( property_tag_array );
+	    mapi_object_release( &hierarchy_table );
+	    throw mapi_exception( GetLastError(), "FolderFetcher::fetchChildren : SetColumns" );
+	}
+	MAPIFreeBuffer( property_tag_array );
+
+	while ( (QueryRows( &hierarchy_table, FolderModel::PageSize, TBL_ADVANCE, TBL_FORWARD_READ, &row_set ) == MAPI_E_SUCCESS) && row_set.cRows ) {
+	    QList<FolderRow> rows;
+	    for (uint32_t i = 0; i < row_set.cRows; ++i) {
+		const uint32_t *child_count = static_cast<const uint32_t*>( find_SPropValue_data( &row_set.aRow[i], PR_FOLDER_CHILD_COUNT ) );
+
+		FolderRow row;
+		row.fid = row_set.aRow[i].lpProps[0].value.d;
+		row.displayName = columnString( &row_set.aRow[i], PR_DISPLAY_NAME );
+		row.containerClass = columnString( &row_set.aRow[i], PR_CONTAINER_CLASS );
+		row.childCount = child_count ? *child_count : 0;
+		rows << row;
+	    }
+	    MAPIFreeBuffer( row_set.aRow );
+
+	    // Large hierarchies show up page by page
+	    emit fetched( fid, rows );
+	}
+
+	mapi_object_release( &hierarchy_table );
+    }
+    catch (mapi_exception e) // Catch any mapi exceptions
+    {
+	std::cout << "MAPI Exception @ FolderFetcher::fetchChildren: " <<  e.what() << std::endl;
+    }
+
+    // Also answers a folder with no subfolder left
+    emit fetched( fid, QList<FolderRow>() );
+}
+
+FolderModel::FolderModel( libmapipp::session *mapi_session, QObject *parent ) :
+  QStandardItemModel( parent ), m_topState( NotFetched )
+{
+    QStringList folderModelHeaders;
+    folderModelHeaders << QString( "Folder Name" ) << QString( "FolderId" ) << QString( "Container Class" );
+    setHorizontalHeaderLabels( folderModelHeaders );
+
+    qRegisterMetaType< QList<FolderRow> >();
+
+    m_fetcher = new FolderFetcher( mapi_session );
+    m_fetcher->moveToThread( &m_thread );
+    connect( this, SIGNAL( topRequested() ), m_fetcher, SLOT( fetchTop() ) );
+    connect( this, SIGNAL( childrenRequested(quint64) ), m_fetcher, SLOT( fetchChildren(quint64) ) );
+    connect( m_fetcher, SIGNAL( fetched(quint64, QList<FolderRow>) ),
+	     this, SLOT( rowsFetched(quint64, QList<FolderRow>) ) );
+    m_thread.start();
+}
+
+FolderModel::~FolderModel()
+{
+    m_thread.quit();
+    m_thread.wait();
+    delete m_fetcher;
+}
+
+bool FolderModel::hasChildren( const QModelIndex &parent ) const
+{
+    if ( !parent.isValid() )
+	return m_topState != Fetched || QStandardItemModel::hasChildren( parent );
+
+    QStandardItem *item = itemFromIndex( parent.sibling( parent.row(), 0 ) );
+    if ( item && item->data( FetchStateRole ).toInt() != Fetched )
+	return item->data( ChildCountRole ).toUInt() > 0;
+
+    return QStandardItemModel::hasChildren( parent );
+}
+
+bool FolderModel::canFetchMore( const QModelIndex &parent ) const
+{
+    if ( !parent.isValid() )
+	return m_topState == NotFetched;
+
+    QStandardItem *item = itemFromIndex( parent.sibling( parent.row(), 0 ) );
+    return item && item->data( FetchStateRole ).toInt() == NotFetched && item->data( ChildCountRole ).toUInt() > 0;
+}
+
+void FolderModel::fetchMore( const QModelIndex &parent )
 {
-      property_container up_folder_property_container = up_folder.get_property_container();
-      up_folder_property_container << PR_DISPLAY_NAME << PR_CONTAINER_CLASS;
-      up_folder_property_container.fetch();
-
-      std::string display_name = static_cast<const char*>(up_folder_property_container[PR_DISPLAY_NAME]);
-      std::string container_class;
-      if (up_folder_property_container[PR_CONTAINER_CLASS])
-	      container_class = static_cast<const char*>(up_folder_property_container[PR_CONTAINER_CLASS]);
-
-      QList< QStandardItem * > row;
-      QStandardItem *name = new QStandardItem( QString::fromStdString( display_name ) );
-      name->setData( (qlonglong)up_folder.get_id() );
-      QStandardItem *folderId = new QStandardItem( QString::number( up_folder.get_id(), 16 ) );
-      QStandardItem *containerClass = new QStandardItem( QString::fromStdString( container_class ) );
-      row << name << folderId << containerClass;
-
-      parentItem->appendRow( row );
-
-      // Fetch Top Information Folder Hierarchy (child folders)
-      folder::hierarchy_container_type hierarchy = up_folder.fetch_hierarchy();
-      for (unsigned int i = 0; i < hierarchy.size(); ++i) {
-	      add_folder_to_tree(*hierarchy[i], name);
-      }
+    if ( !canFetchMore( parent ) )
+	return;
+
+    // Answered by rowsFetched(), the view does not wait for the server
+    if ( !parent.isValid() ) {
+	m_topState = Fetching;
+	emit topRequested();
+	return;
+    }
+
+    QStandardItem *item = itemFromIndex( parent.sibling( parent.row(), 0 ) );
+    item->setData( Fetching, FetchStateRole );
+    emit childrenRequested( item->data( FidRole ).toULongLong() );
 }
 
-QStandardItemModel* FolderModel::buildModel()
+void FolderModel::rowsFetched( quint64 parentFid, const QList<FolderRow> &rows )
 {
-      try {
-	    // Get Default Top Information Store folder ID
-	    mapi_id_t top_folder_id = m_mapi_session->get_message_store().get_default_folder(olFolderTopInformationStore);
-
-	    // Open Top Information Folder
-	    folder top_folder( m_mapi_session->get_message_store(), top_folder_id );
-
-	    QStandardItem *parentItem = m_folderModel->invisibleRootItem();
-
-	    add_folder_to_tree(top_folder, parentItem);
-      }
-      catch (mapi_exception e) // Catch any mapi exceptions
-      {
-              std::cout << "MAPI Exception @ main: " <<  e.what() << std::endl;
-      }
-      catch (std::runtime_error e) // Catch runtime exceptions
-      {
-              std::cout << "std::runtime_error exception @ main: " << e.what() << std::endl;
-      }
-      return m_folderModel;
+    QStandardItem *parentItem;
+
+    if ( parentFid == 0 ) {
+	m_topState = Fetched;
+	parentItem = invisibleRootItem();
+    } else {
+	parentItem = m_items.value( parentFid );
+	if ( !parentItem )
+	    return;
+	parentItem->setData( Fetched, FetchStateRole );
+    }
+
+    foreach ( const FolderRow &folderRow, rows ) {
+	if ( m_items.contains( folderRow.fid ) )
+	    continue;
+
+	QList< QStandardItem * > row;
+	QStandardItem *name = new QStandardItem( folderRow.displayName );
+	name->setData( (qlonglong)folderRow.fid, FidRole );
+	name->setData( folderRow.childCount, ChildCountRole );
+	name->setData( NotFetched, FetchStateRole );
+	QStandardItem *folderId = new QStandardItem( QString::number( folderRow.fid, 16 ) );
+	QStandardItem *containerClass = new QStandardItem( folderRow.containerClass );
+	row << name << folderId << containerClass;
+
+	parentItem->appendRow( row );
+	m_items.insert( folderRow.fid, name );
+    }
 }
 
 
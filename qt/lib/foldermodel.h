@@ -1,8 +1,13 @@
 #ifndef FOLDERMODEL_H
 #define FOLDERMODEL_H
 
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <QtCore/QThread>
+#include <QtGui/QStandardItemModel>
+
 class QStandardItem;
-class QStandardItemModel;
 
 namespace libmapipp
 {
@@ -10,20 +15,72 @@ class folder;
 class session;
 }
 
-class FolderModel : public QStandardItemModel
+struct FolderRow
+{
+    quint64 fid;
+    QString displayName;
+    QString containerClass;
+    quint32 childCount;
+};
+
+Q_DECLARE_METATYPE( QList<FolderRow> )
+
+/*
+ * Reads one level of the folder hierarchy at a time, on the model
+ * worker thread.
+ */
+class FolderFetcher : public QObject
 {
     Q_OBJECT
 
   public:
-    FolderModel( libmapipp::session *mapi_session );
+    FolderFetcher( libmapipp::session *mapi_session );
 
-    QStandardItemModel* buildModel();
+  public slots:
+    void fetchTop();
+    void fetchChildren( quint64 fid );
+
+  signals:
+    void fetched( quint64 parentFid, const QList<FolderRow> &rows );
 
   private:
     libmapipp::session *m_mapi_session;
-    QStandardItemModel *m_folderModel;
-    
-    void add_folder_to_tree(libmapipp::folder& up_folder, QStandardItem *parentItem);
+};
+
+/*
+ * The folder hierarchy of the mailbox. The subfolders of a folder are
+ * read from the server when it is expanded. The folder id is the
+ * Qt::UserRole + 1 data of the first column.
+ */
+class FolderModel : public QStandardItemModel
+{
+    Q_OBJECT
+
+  public:
+    static const int PageSize = 100;
+
+    FolderModel( libmapipp::session *mapi_session, QObject *parent = 0 );
+    ~FolderModel();
+
+    bool hasChildren( const QModelIndex &parent = QModelIndex() ) const;
+    bool canFetchMore( const QModelIndex &parent ) const;
+    void fetchMore( const QModelIndex &parent );
+
+  signals:
+    void topRequested();
+    void childrenRequested( quint64 fid );
+
+  private slots:
+    void rowsFetched( quint64 parentFid, const QList<FolderRow> &rows );
+
+  private:
+    enum { FidRole = Qt::UserRole + 1, ChildCountRole, FetchStateRole };
+    enum { NotFetched, Fetching, Fetched };
+
+    QThread m_thread;
+    FolderFetcher *m_fetcher;
+    QHash<quint64, QStandardItem*> m_items;
+    int m_topState;
 };
 
 
@@ -0,0 +1,17 @@
+#ifndef MAPILOCK_H
+#define MAPILOCK_H
+
+#include <QtCore/QMutex>
+
+/*
+ * libmapi sessions are not thread safe. The models read their tables on
+ * worker threads, so every call on the session, from any thread, must be
+ * made with this lock held.
+ */
+inline QMutex *mapiLock()
+{
+    static QMutex lock( QMutex::Recursive );
+    return &lock;
+}
+
+#endif
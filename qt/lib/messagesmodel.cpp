@@ -1,55 +1,173 @@
 #include "messagesmodel.h"
+#include "mapilock.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <iostream>
 
 #include <libmapi++/libmapi++.h>
 
 using namespace libmapipp;
 
-MessagesModel::MessagesModel( libmapipp::folder *folder ):
-  m_mapi_folder( folder )
+static QString columnString( const message_row &row, uint32_t property_tag )
 {
+    const char *value = static_cast<const char*>( row[property_tag] );
+    return value ? QString::fromUtf8( value ) : QString();
 }
-    
-QStandardItemModel* MessagesModel::buildModel()
-{
-    // Fetch messages in Inbox Folder
-    folder::message_container_type messages = m_mapi_folder->fetch_messages();
 
-    QStandardItemModel *messagesModel = new QStandardItemModel();
-    QStringList messagesModelHeaders;
-    messagesModelHeaders << QString( "Topic" ) << QString( "To" ) << QString( "From" );
-    messagesModel->setHorizontalHeaderLabels( messagesModelHeaders );
+MessagesFetcher::MessagesFetcher( libmapipp::folder *folder ):
+  m_mapi_folder( folder ), m_started( false )
+{
+}
 
-    for ( unsigned int i = 0; i < messages.size(); ++i ) {
-	property_container message_property_container = messages[i]->get_property_container();
+MessagesFetcher::~MessagesFetcher()
+{
+    // Releasing the table is a call on the session
+    QMutexLocker locker( mapiLock() );
+    m_table.reset();
+}
 
-	// Add Property Tags to be fetched and then fetch the properties.
-	message_property_container << PR_DISPLAY_TO << PR_CONVERSATION_TOPIC << PR_SENDER_NAME;
-	message_property_container.fetch_all();
+void MessagesFetcher::fetch( int count )
+{
+    QList<MessageRow> rows;
+    bool atEnd = true;
 
-	std::string to;
-	std::string subject;
-	std::string from;
+    QMutexLocker locker( mapiLock() );
+    try {
+	if ( !m_started ) {
+	    std::vector<uint32_t> columns;
+	    columns.push_back( PR_CONVERSATION_TOPIC );
+	    columns.push_back( PR_DISPLAY_TO );
+	    columns.push_back( PR_SENDER_NAME );
+	    m_table.reset( new message_table( m_mapi_folder->messages( columns, MessagesModel::PageSize ) ) );
+	    m_started = true;
+	}
 
-	for (property_container::iterator Iter = message_property_container.begin(); Iter != message_property_container.end(); Iter++)
-	{
-		if (Iter.get_tag() == PR_DISPLAY_TO)
-			to = (const char*) *Iter;
-		else if (Iter.get_tag() == PR_CONVERSATION_TOPIC)
-			subject = (const char*) *Iter;
-		else if (Iter.get_tag() == PR_SENDER_NAME)
-			from = (const char*) *Iter;
+	// The table reads PageSize rows per QueryRows, as the rows are consumed
+	message_table::iterator it = m_table->begin();
+	for ( ; it != m_table->end() && rows.size() < count; ++it ) {
+	    message_row row = *it;
+	    MessageRow messageRow;
+	    messageRow.mid = row.get_id();
+	    messageRow.subject = columnString( row, PR_CONVERSATION_TOPIC );
+	    messageRow.to = columnString( row, PR_DISPLAY_TO );
+	    messageRow.from = columnString( row, PR_SENDER_NAME );
+	    rows << messageRow;
 	}
-	QList< QStandardItem * > row;
-	row << new QStandardItem( QString::fromStdString( subject ) );
-	row[0]->setData( (quint32) i );
-	row << new QStandardItem( QString::fromStdString( to ) );
-	row << new QStandardItem( QString::fromStdString( from ) );
-	messagesModel->appendRow( row );
+	atEnd = ( it == m_table->end() );
+    }
+    catch (mapi_exception e)
+    {
+	std::cout << "MAPI Exception @ MessagesFetcher::fetch: " << e.what() << std::endl;
+    }
+
+    emit fetched( rows, atEnd );
+}
+
+MessagesModel::MessagesModel( libmapipp::folder *folder, QObject *parent ):
+  QAbstractTableModel( parent ), m_fetching( false ), m_atEnd( false )
+{
+    qRegisterMetaType< QList<MessageRow> >();
+
+    m_fetcher = new MessagesFetcher( folder );
+    m_fetcher->moveToThread( &m_thread );
+    connect( this, SIGNAL( fetchRequested(int) ), m_fetcher, SLOT( fetch(int) ) );
+    connect( m_fetcher, SIGNAL( fetched(QList<MessageRow>, bool) ),
+	     this, SLOT( rowsFetched(QList<MessageRow>, bool) ) );
+    m_thread.start();
+}
+
+MessagesModel::~MessagesModel()
+{
+    m_thread.quit();
+    m_thread.wait();
+    delete m_fetcher;
+}
+
+int MessagesModel::rowCount( const QModelIndex &parent ) const
+{
+    return parent.isValid() ? 0 : m_mids.size();
+}
+
+int MessagesModel::columnCount( const QModelIndex &parent ) const
+{
+    return parent.isValid() ? 0 : 3;
+}
+
+QVariant MessagesModel::data( const QModelIndex &index, int role ) const
+{
+    if ( !index.isValid() || index.row() >= m_mids.size() )
+	return QVariant();
+
+    const MessageRow &row = m_rows[m_mids[index.row()]];
+    if ( role == Qt::UserRole && index.column() == 0 )
+	return row.mid;
+    if ( role != Qt::DisplayRole )
+	return QVariant();
+
+    switch ( index.column() ) {
+    case 0:
+	return row.subject;
+    case 1:
+	return row.to;
+    case 2:
+	return row.from;
     }
-    
-    return messagesModel;
+
+    return QVariant();
 }
 
+QVariant MessagesModel::headerData( int section, Qt::Orientation orientation, int role ) const
+{
+    if ( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+	return QVariant();
+
+    switch ( section ) {
+    case 0:
+	return QString( "Topic" );
+    case 1:
+	return QString( "To" );
+    case 2:
+	return QString( "From" );
+    }
+
+    return QVariant();
+}
+
+bool MessagesModel::canFetchMore( const QModelIndex &parent ) const
+{
+    return !parent.isValid() && !m_atEnd;
+}
+
+void MessagesModel::fetchMore( const QModelIndex &parent )
+{
+    if ( parent.isValid() || m_fetching || m_atEnd )
+	return;
+
+    // Answered by rowsFetched(), the view does not wait for the server
+    m_fetching = true;
+    emit fetchRequested( PageSize );
+}
+
+void MessagesModel::rowsFetched( const QList<MessageRow> &rows, bool atEnd )
+{
+    m_fetching = false;
+    m_atEnd = atEnd;
+
+    QVector<quint64> mids;
+    foreach ( const MessageRow &row, rows ) {
+	// A message moved while the table was read may be returned twice
+	if ( !m_rows.contains( row.mid ) )
+	    mids << row.mid;
+	m_rows.insert( row.mid, row );
+    }
+
+    if ( !mids.isEmpty() ) {
+	beginInsertRows( QModelIndex(), m_mids.size(), m_mids.size() + mids.size() - 1 );
+	m_mids += mids;
+	endInsertRows();
+    }
+}
 
 
 #include "messagesmodel.moc"
@@ -1,27 +1,91 @@
 #ifndef MESSAGESMODEL_H
 #define MESSAGESMODEL_H
 
-class QStandardItem;
-#include <QStandardItemModel>
+#include <QtCore/QAbstractTableModel>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+
+#include <memory>
 
 namespace libmapipp
 {
 class folder;
+class message_table;
 class session;
 }
 
+struct MessageRow
+{
+    quint64 mid;
+    QString subject;
+    QString to;
+    QString from;
+};
+
+Q_DECLARE_METATYPE( QList<MessageRow> )
 
-class MessagesModel : public QStandardItemModel
+/*
+ * Reads the contents table of a folder, one page at a time, on the
+ * model worker thread.
+ */
+class MessagesFetcher : public QObject
 {
     Q_OBJECT
-    
+
   public:
-    MessagesModel( libmapipp::folder *folder );
-    
-    QStandardItemModel *buildModel();
-    
+    MessagesFetcher( libmapipp::folder *folder );
+    ~MessagesFetcher();
+
+  public slots:
+    void fetch( int count );
+
+  signals:
+    void fetched( const QList<MessageRow> &rows, bool atEnd );
+
   private:
     libmapipp::folder *m_mapi_folder;
+    std::unique_ptr<libmapipp::message_table> m_table;
+    bool m_started;
+};
+
+/*
+ * The messages of a folder, read from the server as the view scrolls.
+ * Rows are kept by MID, the Qt::UserRole of the first column.
+ */
+class MessagesModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+  public:
+    static const int PageSize = 100;
+
+    MessagesModel( libmapipp::folder *folder, QObject *parent = 0 );
+    ~MessagesModel();
+
+    int rowCount( const QModelIndex &parent = QModelIndex() ) const;
+    int columnCount( const QModelIndex &parent = QModelIndex() ) const;
+    QVariant data( const QModelIndex &index, int role = Qt::DisplayRole ) const;
+    QVariant headerData( int section, Qt::Orientation orientation, int role = Qt::DisplayRole ) const;
+
+    bool canFetchMore( const QModelIndex &parent ) const;
+    void fetchMore( const QModelIndex &parent );
+
+  signals:
+    void fetchRequested( int count );
+
+  private slots:
+    void rowsFetched( const QList<MessageRow> &rows, bool atEnd );
+
+  private:
+    QThread m_thread;
+    MessagesFetcher *m_fetcher;
+    QVector<quint64> m_mids;
+    QHash<quint64, MessageRow> m_rows;
+    bool m_fetching;
+    bool m_atEnd;
 };
 
 #endif
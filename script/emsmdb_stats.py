@@ -0,0 +1,168 @@
+#!/usr/bin/python
+#
+# OpenChange ROP statistics reader
+#
+# Copyright (C) OpenChange Project 2015
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+#
+# Usage example:
+# ./script/emsmdb_stats.py /var/lib/samba/lock/emsmdb-*.stats
+#
+# Sums the emsmdb-<pid>.stats files written by the emsmdb workers when
+# emsmdb:rop_stats is enabled and prints, for every ROP seen, the
+# number of calls and failures with the mean, p50, p99 and maximum
+# latencies. Percentiles are upper bounds of the histogram buckets.
+# The memory gauge of the sessions hosted by each worker follows, then
+# the number of emsmdbp objects of each type.
+#
+
+import struct
+import sys
+
+STATS_MAGIC = 0x4f435354
+STATS_VERSION = 3
+STATS_ROPS = 256
+STATS_SESSIONS = 256
+STATS_OBJECT_TYPES = 16
+
+HEADER = struct.Struct("=IIIIQ")
+SESSION = struct.Struct("=IIQQ64s")
+OBJECT = struct.Struct("=QQ")
+MEMORY_STATES = ("normal", "soft", "hard")
+OBJECT_TYPES = ("undefined", "mailbox", "folder", "message", "table", "stream",
+                "attachment", "subscription", "ftcontext", "synccontext")
+
+
+def read_stats(path):
+    fh = open(path, 'rb')
+    try:
+        data = fh.read()
+    finally:
+        fh.close()
+
+    if len(data) < HEADER.size:
+        return None
+    magic, version, pid, buckets, started = HEADER.unpack_from(data, 0)
+    if magic != STATS_MAGIC or version not in (1, 2, STATS_VERSION):
+        return None
+
+    rop = struct.Struct("=QQQQ%dQ" % buckets)
+    offset = HEADER.size + STATS_ROPS * rop.size
+    if len(data) < offset:
+        return None
+
+    rops = {}
+    for opnum in range(STATS_ROPS):
+        values = rop.unpack_from(data, HEADER.size + opnum * rop.size)
+        if values[0]:
+            rops[opnum] = (values[0], values[1], values[2], values[3], list(values[4:]))
+
+    sessions = []
+    if version >= 2 and len(data) >= offset + STATS_SESSIONS * SESSION.size:
+        for i in range(STATS_SESSIONS):
+            in_use, state, size, peak, username = SESSION.unpack_from(data, offset + i * SESSION.size)
+            if in_use:
+                sessions.append((pid, username.split(b'\0', 1)[0].decode('utf-8', 'replace'),
+                                 state, size, peak))
+
+    objects = {}
+    offset += STATS_SESSIONS * SESSION.size
+    if version >= 3 and len(data) >= offset + STATS_OBJECT_TYPES * OBJECT.size:
+        for objtype in range(STATS_OBJECT_TYPES):
+            live, created = OBJECT.unpack_from(data, offset + objtype * OBJECT.size)
+            if created:
+                objects[objtype] = (live, created)
+    return rops, sessions, objects
+
+
+def merge(total, rops):
+    for opnum, (count, errors, usec, max_usec, buckets) in rops.items():
+        if opnum not in total:
+            total[opnum] = [0, 0, 0, 0, [0] * len(buckets)]
+        entry = total[opnum]
+        entry[0] += count
+        entry[1] += errors
+        entry[2] += usec
+        entry[3] = max(entry[3], max_usec)
+        entry[4] = [a + b for a, b in zip(entry[4], buckets)]
+
+
+def percentile(buckets, count, ratio):
+    threshold = count * ratio
+    seen = 0
+    for bucket, value in enumerate(buckets):
+        seen += value
+        if seen >= threshold:
+            return 1 << bucket
+    return 1 << (len(buckets) - 1)
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: %s FILE...\n" % sys.argv[0])
+        return 1
+
+    total = {}
+    sessions = []
+    objects = {}
+    for path in sys.argv[1:]:
+        try:
+            stats = read_stats(path)
+        except (IOError, OSError) as e:
+            sys.stderr.write("%s: %s\n" % (path, e))
+            continue
+        if stats is None:
+            sys.stderr.write("%s: not a ROP statistics file\n" % path)
+            continue
+        merge(total, stats[0])
+        sessions.extend(stats[1])
+        for objtype, (live, created) in stats[2].items():
+            entry = objects.setdefault(objtype, [0, 0])
+            entry[0] += live
+            entry[1] += created
+
+    print("%-6s %10s %8s %10s %10s %10s %10s" % ("ROP", "calls", "errors", "mean(us)",
+                                                 "p50(us)", "p99(us)", "max(us)"))
+    for opnum in sorted(total):
+        count, errors, usec, max_usec, buckets = total[opnum]
+        print("0x%.2x   %10d %8d %10d %10d %10d %10d" % (opnum, count, errors, usec / count,
+                                                       percentile(buckets, count, 0.5),
+                                                       percentile(buckets, count, 0.99),
+                                                       max_usec))
+
+    if sessions:
+        print("")
+        print("%-8s %-32s %-7s %12s %12s" % ("pid", "session", "state", "size(KB)", "peak(KB)"))
+        for pid, username, state, size, peak in sorted(sessions, key=lambda s: s[3], reverse=True):
+            if state < len(MEMORY_STATES):
+                state = MEMORY_STATES[state]
+            print("%-8d %-32s %-7s %12d %12d" % (pid, username, state, size / 1024, peak / 1024))
+
+    if objects:
+        print("")
+        print("%-12s %10s %12s" % ("object", "live", "created"))
+        for objtype in sorted(objects):
+            live, created = objects[objtype]
+            if objtype < len(OBJECT_TYPES):
+                name = OBJECT_TYPES[objtype]
+            else:
+                name = "0x%x" % objtype
+            print("%-12s %10d %12d" % (name, live, created))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -539,6 +539,37 @@ temporary_private_tags_struct = """\t{ openchange_private_ROOT_FOLDER_FID,		PT_I
 	{ openchange_private_PF_LOCAL_OAB,		PT_I8, "openchange_private_PF_LOCAL_OAB" },
 """
 
+def make_proptags_lookup_tables(tablelines, definelines, altnamelines):
+	# tag values are taken from the "/* 0x........ */" comment of each #define
+	tagvalues = {}
+	for line in definelines:
+		for match in re.finditer(r"#define\s+(\w+)\s+PROP_TAG\([^)]*\)\s*/\*\s*(0x[0-9a-fA-F]{8})", line):
+			tagvalues[match.group(1)] = int(match.group(2), 16)
+	entries = []
+	for line in tablelines:
+		for match in re.finditer(r"\{\s*(\w+),\s*\w+,\s*\"(\w+)\"\s*\}", line):
+			entries.append((match.group(1), match.group(2)))
+	bytag = sorted(range(len(entries)), key=lambda idx: (tagvalues[entries[idx][0]], idx))
+	byname = sorted(range(len(entries)), key=lambda idx: (entries[idx][1], idx))
+
+	content = ""
+	for (arrayname, indexes) in (("canonical_property_tags_by_tag", bytag), ("canonical_property_tags_by_name", byname)):
+		content += "\nstatic const uint16_t " + arrayname + "[] = {\n"
+		for start in range(0, len(indexes), 12):
+			content += "\t" + " ".join(string.rjust(str(idx) + ",", 5) for idx in indexes[start:start + 12]).rstrip(",") + ",\n"
+		content += "};\n"
+
+	altnames = []
+	for line in altnamelines:
+		match = re.match(r"#define\s+(\w+)", line)
+		if match:
+			altnames.append(match.group(1))
+	content += "\nstatic const struct mapi_propaltnames property_altnames_table[] = {\n"
+	for altname in sorted(altnames):
+		content += "\t{ " + string.ljust("\"" + altname + "\",", 70) + string.ljust(altname, 68) + " },\n"
+	content += "};\n"
+	return content
+
 def make_mapi_properties_file():
 	proplines = []
 	altnamelines = []
@@ -664,6 +695,7 @@ def make_mapi_properties_file():
 	for propline in sortedproplines:
 		f.write(propline)
 	f.close()
+	headerlines = sortedproplines
 	f = open('libmapi/property_altnames.h', 'w')
 	f.write("/* Automatically generated by script/makepropslist.py. Do not edit */\n")
 	sortedaltnamelines = sorted(altnamelines)
@@ -679,7 +711,8 @@ def make_mapi_properties_file():
 	f.write("#include \"libmapi/libmapi.h\"\n")
 	f.write("#include \"libmapi/libmapi_private.h\"\n")
 	f.write("#include \"gen_ndr/ndr_exchange.h\"\n")
-	f.write("#include \"libmapi/property_tags.h\"\n\n")
+	f.write("#include \"libmapi/property_tags.h\"\n")
+	f.write("#include \"libmapi/property_altnames.h\"\n\n")
 	f.write("struct mapi_proptags\n")
 	f.write("{\n")
 	f.write("\tuint32_t	proptag;\n")
@@ -687,6 +720,12 @@ def make_mapi_properties_file():
 	f.write("\tconst char	*propname;\n")
 	f.write("};\n")
 	f.write("\n")
+	f.write("struct mapi_propaltnames\n")
+	f.write("{\n")
+	f.write("\tconst char	*propname;\n")
+	f.write("\tuint32_t	proptag;\n")
+	f.write("};\n")
+	f.write("\n")
 	for entry in properties:
 		if (entry.has_key("CanonicalName") == False):
 			print "Section", entry["OXPROPS_Sect"], "has no canonical name entry"
@@ -714,53 +753,121 @@ def make_mapi_properties_file():
 		f.write(propline)
 	f.write("\t{ 0,                                                                  0,            \"NULL\"                                                              }\n")
 	f.write("};\n")
+	f.write(make_proptags_lookup_tables(sortedproplines, headerlines + sortedaltnamelines, sortedaltnamelines))
 	f.write("""
+#define CANONICAL_PROPERTY_TAGS_COUNT (sizeof (canonical_property_tags_by_tag) / sizeof (canonical_property_tags_by_tag[0]))
+#define PROPERTY_ALTNAMES_COUNT (sizeof (property_altnames_table) / sizeof (property_altnames_table[0]))
+
+/**
+   \\details Return the position in canonical_property_tags_by_tag of
+   the first canonical entry whose tag is greater or equal to proptag
+ */
+static uint32_t get_proptag_lower_bound(uint32_t proptag)
+{
+	uint32_t	low = 0;
+	uint32_t	high = CANONICAL_PROPERTY_TAGS_COUNT;
+	uint32_t	mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (canonical_property_tags[canonical_property_tags_by_tag[mid]].proptag < proptag) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+static const char *get_canonical_proptag_name(uint32_t proptag)
+{
+	uint32_t	pos;
+
+	pos = get_proptag_lower_bound(proptag);
+	if (pos < CANONICAL_PROPERTY_TAGS_COUNT &&
+	    canonical_property_tags[canonical_property_tags_by_tag[pos]].proptag == proptag) {
+		return canonical_property_tags[canonical_property_tags_by_tag[pos]].propname;
+	}
+
+	return NULL;
+}
+
 _PUBLIC_ const char *get_proptag_name(uint32_t proptag)
 {
-	uint32_t idx;
+	const char	*propname;
 
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if (canonical_property_tags[idx].proptag == proptag) { 
-			return canonical_property_tags[idx].propname;
-		}
+	propname = get_canonical_proptag_name(proptag);
+	if (propname) {
+		return propname;
 	}
 	if (((proptag & 0xFFFF) == PT_STRING8) ||
 	    ((proptag & 0xFFFF) == PT_MV_STRING8)) {
 		proptag += 1; /* try as _UNICODE variant */
-	}
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if (canonical_property_tags[idx].proptag == proptag) { 
-			return canonical_property_tags[idx].propname;
-		}
+		return get_canonical_proptag_name(proptag);
 	}
 	return NULL;
 }
 
-_PUBLIC_ uint32_t get_proptag_value(const char *propname)
+static int property_altnames_cmp(const void *key, const void *member)
 {
-	uint32_t idx;
+	return strcmp((const char *)key, ((const struct mapi_propaltnames *)member)->propname);
+}
 
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if (!strcmp(canonical_property_tags[idx].propname, propname)) { 
-			return canonical_property_tags[idx].proptag;
+_PUBLIC_ uint32_t get_proptag_value(const char *propname)
+{
+	const struct mapi_propaltnames	*altname;
+	uint32_t			low = 0;
+	uint32_t			high = CANONICAL_PROPERTY_TAGS_COUNT;
+	uint32_t			mid;
+	int				cmp;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		cmp = strcmp(canonical_property_tags[canonical_property_tags_by_name[mid]].propname, propname);
+		if (cmp < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
 		}
 	}
+	if (low < CANONICAL_PROPERTY_TAGS_COUNT &&
+	    !strcmp(canonical_property_tags[canonical_property_tags_by_name[low]].propname, propname)) {
+		return canonical_property_tags[canonical_property_tags_by_name[low]].proptag;
+	}
+
+	/* Fallback on alternative names (PR_*) */
+	altname = bsearch(propname, property_altnames_table, PROPERTY_ALTNAMES_COUNT,
+			  sizeof (struct mapi_propaltnames), property_altnames_cmp);
+	if (altname) {
+		return altname->proptag;
+	}
 
 	return 0;
 }
 
 _PUBLIC_ uint16_t get_property_type(uint16_t untypedtag)
 {
+	uint32_t	pos;
 	uint32_t	idx;
+	uint32_t	found = CANONICAL_PROPERTY_TAGS_COUNT;
 	uint16_t	current_type;
 
-	for (idx = 0; canonical_property_tags[idx].proptag; idx++) {
-		if ((canonical_property_tags[idx].proptag >> 16) == untypedtag) {
-			current_type = canonical_property_tags[idx].proptype;
-			if (current_type != PT_ERROR && current_type != PT_STRING8) {
-				return current_type;
-			}
+	/* Entries sharing the same property ID are adjacent, keep
+	 * the first match in canonical table order */
+	for (pos = get_proptag_lower_bound((uint32_t)untypedtag << 16);
+	     pos < CANONICAL_PROPERTY_TAGS_COUNT; pos++) {
+		idx = canonical_property_tags_by_tag[pos];
+		if ((canonical_property_tags[idx].proptag >> 16) != untypedtag) {
+			break;
 		}
+		current_type = canonical_property_tags[idx].proptype;
+		if (current_type != PT_ERROR && current_type != PT_STRING8 && idx < found) {
+			found = idx;
+		}
+	}
+	if (found < CANONICAL_PROPERTY_TAGS_COUNT) {
+		return canonical_property_tags[found].proptype;
 	}
 
 	OC_DEBUG(5, "type for property '%x' could not be deduced", untypedtag);
@@ -1354,6 +1461,7 @@ struct mapi_nameid {
 static struct mapi_nameid_tags mapi_nameid_tags[] = {
 """)
 
+	tagslines = []
 	for line in sortednamedprops:
 		if line[5] == "MNID_ID":
 			OOM = "\"%s\"" % line[1]
@@ -1362,6 +1470,7 @@ static struct mapi_nameid_tags mapi_nameid_tags[] = {
 			propline = "{ %s, %s, %s, %s, %s, %s, %s, %s },\n" % (
 				string.ljust(line[0], 60), string.ljust(OOM, 65), line[2], line[3], 
 				string.ljust(datatype, 15), "MNID_ID", line[6], "0x0")
+			tagslines.append(propline)
 			f.write(propline)
 
 	for line in sortednamedprops:
@@ -1372,12 +1481,14 @@ static struct mapi_nameid_tags mapi_nameid_tags[] = {
 			propline = "{ %s, %s, %s, \"%s\", %s, %s, %s, %s },\n" % (
 				string.ljust(line[0], 60), string.ljust(OOM, 65), line[2], line[3], 
 				string.ljust(datatype, 15), "MNID_STRING", line[6], "0x0")
+			tagslines.append(propline)
 			f.write(propline)
 
 	# Addtional named properties
 	propline = "{ %s, %s, %s, %s, %s, %s, %s, %s },\n" % (
 		string.ljust("PidLidRemoteTransferSize", 60), string.ljust("\"RemoteTransferSize\"", 65), "0x8f05",
 		"NULL", string.ljust("PT_LONG", 15), "MNID_ID", "PSETID_Remote", "0x0")
+	tagslines.append(propline)
 	f.write(propline)
 
 	propline = "{ %s, %s, %s, %s, %s, %s, %s, %s }\n" % (
@@ -1391,8 +1502,10 @@ static struct mapi_nameid_tags mapi_nameid_tags[] = {
 	f.write("""
 static struct mapi_nameid_names mapi_nameid_names[] = {
 """)
+	nameslines = []
 	for line in sortednamedprops:
 		propline = "{ %s, \"%s\" },\n" % (string.ljust(line[0], 60), line[0])
+		nameslines.append(propline)
 		f.write(propline)
 
 	# Additional named properties
@@ -1402,11 +1515,56 @@ static struct mapi_nameid_names mapi_nameid_names[] = {
 	f.write(propline)
 	f.write("""
 };
+""")
 
+	tagvalues = {}
+	for line in open('libmapi/mapi_nameid.h'):
+		match = re.match(r"#define\s+(\w+)\s+(0x[0-9a-fA-F]+)", line)
+		if match:
+			tagvalues[match.group(1)] = int(match.group(2), 16)
+	f.write(make_named_props_lookup_tables(tagslines, nameslines, tagvalues))
+	f.write("""
 #endif /* !MAPI_NAMEID_PRIVATE_H__ */
 """)
 	f.close()
 
+def make_named_props_lookup_tables(tagslines, nameslines, tagvalues):
+	# tag values are taken from the #define lines written to mapi_nameid.h
+	tags = []
+	for line in tagslines:
+		match = re.match(r"\{\s*(\w+)\s*,\s*(NULL|\"[^\"]*\")\s*,\s*(0x[0-9a-fA-F]+)\s*,\s*(NULL|\"[^\"]*\")\s*,", line)
+		if match:
+			OOM = None if match.group(2) == "NULL" else match.group(2)[1:-1]
+			Name = None if match.group(4) == "NULL" else match.group(4)[1:-1]
+			tags.append((tagvalues[match.group(1)], OOM, int(match.group(3), 16), Name))
+	names = []
+	for line in nameslines:
+		match = re.match(r"\{\s*(\w+)\s*,\s*\"(\w+)\"\s*\}", line)
+		if match:
+			names.append((tagvalues[match.group(1)], match.group(2)))
+
+	indexes = []
+	indexes.append(("mapi_nameid_tags_by_proptag",
+			sorted(range(len(tags)), key=lambda idx: (tags[idx][0], idx))))
+	indexes.append(("mapi_nameid_tags_by_lid",
+			sorted([idx for idx in range(len(tags)) if tags[idx][2]], key=lambda idx: (tags[idx][2], idx))))
+	indexes.append(("mapi_nameid_tags_by_OOM",
+			sorted([idx for idx in range(len(tags)) if tags[idx][1] is not None], key=lambda idx: (tags[idx][1], idx))))
+	indexes.append(("mapi_nameid_tags_by_Name",
+			sorted([idx for idx in range(len(tags)) if tags[idx][3] is not None], key=lambda idx: (tags[idx][3], idx))))
+	indexes.append(("mapi_nameid_names_by_proptag",
+			sorted(range(len(names)), key=lambda idx: (names[idx][0], idx))))
+	indexes.append(("mapi_nameid_names_by_propname",
+			sorted(range(len(names)), key=lambda idx: (names[idx][1], idx))))
+
+	content = ""
+	for (arrayname, index) in indexes:
+		content += "\nstatic const uint16_t " + arrayname + "[] = {\n"
+		for start in range(0, len(index), 12):
+			content += "\t" + " ".join(string.rjust(str(idx) + ",", 5) for idx in index[start:start + 12]).rstrip(",") + ",\n"
+		content += "};\n"
+	return content
+
 def dump_areas_count():
 	areas = {}
 	for area in knownareas:
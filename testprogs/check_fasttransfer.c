@@ -422,7 +422,9 @@ int main(int argc, const char *argv[])
 		fxparser_set_namedprop_callback(parser, dump_namedprop);
 		fxparser_set_property_callback(parser, dump_property);
 	} else {
+		/* Nothing looks at the values, do not copy them */
 		parser = fxparser_init(mem_ctx, NULL);
+		fxparser_set_zero_copy(parser, true);
 	}
 
 	do {
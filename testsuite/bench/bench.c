@@ -0,0 +1,230 @@
+/*
+   OpenChange Microbenchmarks
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   Every benchmark runs a fixed number of iterations, repeated a few
+   times, and the fastest repetition is reported: the output only
+   depends on the code being measured and the machine, so the outputs
+   of two commits can be diffed or compared with --compare.
+ */
+
+#include "bench.h"
+
+#include <time.h>
+#include <fnmatch.h>
+#include <popt.h>
+
+#define	OC_BENCH_REPEAT		5
+#define	OC_BENCH_NAME_WIDTH	40
+
+struct oc_bench_baseline {
+	struct oc_bench_baseline	*next;
+	char				*name;
+	double				ns;
+};
+
+static double oc_bench_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+   Load the results of a previous run: the lines of our own output
+   which carry a measure
+ */
+static struct oc_bench_baseline *oc_bench_load_baseline(TALLOC_CTX *mem_ctx, const char *path)
+{
+	struct oc_bench_baseline	*head = NULL;
+	struct oc_bench_baseline	*el;
+	FILE				*f;
+	char				line[256];
+	char				name[128];
+	unsigned int			iterations;
+	double				ns;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "[ERROR] Unable to open %s\n", path);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof (line), f)) {
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%127s %u %lf", name, &iterations, &ns) != 3) continue;
+		el = talloc_zero(mem_ctx, struct oc_bench_baseline);
+		el->name = talloc_strdup(el, name);
+		el->ns = ns;
+		el->next = head;
+		head = el;
+	}
+	fclose(f);
+
+	return head;
+}
+
+static const struct oc_bench_baseline *oc_bench_find_baseline(const struct oc_bench_baseline *baseline,
+							       const char *name)
+{
+	for (; baseline; baseline = baseline->next) {
+		if (!strcmp(baseline->name, name)) return baseline;
+	}
+
+	return NULL;
+}
+
+static void oc_bench_run_case(const struct oc_bench_case *bc, uint32_t repeat, double scale,
+			      const struct oc_bench_baseline *baseline)
+{
+	TALLOC_CTX				*mem_ctx;
+	const struct oc_bench_baseline		*prev;
+	void					*state = NULL;
+	uint32_t				iterations;
+	uint32_t				i, r;
+	double					start, elapsed;
+	double					best = 0.0;
+
+	iterations = bc->iterations * scale;
+	if (!iterations) iterations = 1;
+
+	printf("%-*s ", OC_BENCH_NAME_WIDTH, bc->name);
+	fflush(stdout);
+
+	mem_ctx = talloc_named(NULL, 0, "oc_bench_run_case");
+	if (!bc->setup(mem_ctx, &state)) {
+		printf("%10s\n", "skipped");
+		talloc_free(mem_ctx);
+		return;
+	}
+
+	/* warm the caches up */
+	for (i = 0; i < iterations / 10 + 1; i++) {
+		if (!bc->run(state)) goto failed;
+	}
+
+	for (r = 0; r < repeat; r++) {
+		start = oc_bench_now();
+		for (i = 0; i < iterations; i++) {
+			if (!bc->run(state)) goto failed;
+		}
+		elapsed = (oc_bench_now() - start) / iterations;
+		if (!r || elapsed < best) best = elapsed;
+	}
+
+	printf("%10u %12.1f ns/op", iterations, best);
+	prev = oc_bench_find_baseline(baseline, bc->name);
+	if (prev && prev->ns > 0.0) {
+		printf(" %+8.1f%%", (best - prev->ns) * 100.0 / prev->ns);
+	}
+	printf("\n");
+	talloc_free(mem_ctx);
+	return;
+
+failed:
+	printf("%10s\n", "failed");
+	talloc_free(mem_ctx);
+}
+
+int main(int argc, const char *argv[])
+{
+	TALLOC_CTX			*mem_ctx;
+	poptContext			pc;
+	int				opt;
+	const char			*opt_filter = NULL;
+	const char			*opt_compare = NULL;
+	uint32_t			repeat = OC_BENCH_REPEAT;
+	double				scale = 1.0;
+	struct oc_bench_baseline	*baseline = NULL;
+	const struct oc_bench_suite	*suites[3];
+	uint32_t			i, j;
+
+	enum { OPT_FILTER=1000, OPT_REPEAT, OPT_SCALE, OPT_COMPARE, OPT_LIST };
+
+	struct poptOption long_options[] = {
+		POPT_AUTOHELP
+		{ "filter",  0, POPT_ARG_STRING, NULL, OPT_FILTER,  "only run the benchmarks matching PATTERN", "PATTERN" },
+		{ "repeat",  0, POPT_ARG_STRING, NULL, OPT_REPEAT,  "measured repetitions of each benchmark (default: 5)", "N" },
+		{ "scale",   0, POPT_ARG_STRING, NULL, OPT_SCALE,   "multiply the iterations of each benchmark", "FACTOR" },
+		{ "compare", 0, POPT_ARG_STRING, NULL, OPT_COMPARE, "show the change against a previous output", "FILE" },
+		{ "list",    0, POPT_ARG_NONE,   NULL, OPT_LIST,    "list the benchmarks", NULL },
+		{ NULL, 0, 0, NULL, 0, NULL, NULL }
+	};
+
+	mem_ctx = talloc_named(NULL, 0, "openchange-bench");
+
+	suites[0] = libmapi_bench_suite();
+	suites[1] = mapiproxy_bench_suite();
+	suites[2] = mapistore_bench_suite();
+
+	pc = poptGetContext("openchange-bench", argc, argv, long_options, 0);
+	while ((opt = poptGetNextOpt(pc)) != -1) {
+		switch (opt) {
+		case OPT_FILTER:
+			opt_filter = poptGetOptArg(pc);
+			break;
+		case OPT_REPEAT:
+			repeat = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_SCALE:
+			scale = strtod(poptGetOptArg(pc), NULL);
+			break;
+		case OPT_COMPARE:
+			opt_compare = poptGetOptArg(pc);
+			break;
+		case OPT_LIST:
+			for (i = 0; i < sizeof (suites) / sizeof (suites[0]); i++) {
+				for (j = 0; j < suites[i]->count; j++) {
+					printf("%s\n", suites[i]->cases[j].name);
+				}
+			}
+			poptFreeContext(pc);
+			talloc_free(mem_ctx);
+			return EXIT_SUCCESS;
+		default:
+			poptPrintUsage(pc, stderr, 0);
+			return EXIT_FAILURE;
+		}
+	}
+	poptFreeContext(pc);
+
+	if (!repeat || scale <= 0.0) {
+		fprintf(stderr, "[ERROR] repeat and scale must be greater than 0\n");
+		return EXIT_FAILURE;
+	}
+
+	if (opt_compare) {
+		baseline = oc_bench_load_baseline(mem_ctx, opt_compare);
+		if (!baseline) return EXIT_FAILURE;
+	}
+
+	printf("# openchange-bench: %u repetitions, scale %g\n", repeat, scale);
+	for (i = 0; i < sizeof (suites) / sizeof (suites[0]); i++) {
+		printf("# %s\n", suites[i]->name);
+		for (j = 0; j < suites[i]->count; j++) {
+			if (opt_filter && fnmatch(opt_filter, suites[i]->cases[j].name, 0)) continue;
+			oc_bench_run_case(&suites[i]->cases[j], repeat, scale, baseline);
+		}
+	}
+
+	talloc_free(mem_ctx);
+
+	return EXIT_SUCCESS;
+}
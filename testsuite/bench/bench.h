@@ -0,0 +1,76 @@
+/*
+   OpenChange Microbenchmarks
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef	__BENCH_H__
+#define	__BENCH_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <talloc.h>
+
+#ifndef	__BEGIN_DECLS
+#ifdef	__cplusplus
+#define	__BEGIN_DECLS	extern "C" {
+#define	__END_DECLS	}
+#else
+#define	__BEGIN_DECLS
+#define	__END_DECLS
+#endif
+#endif
+
+/**
+   One microbenchmark
+
+   setup prepares the state run works on and returns false when the
+   benchmark can't run here (e.g. no MySQL server), in which case it
+   is reported as skipped. Everything setup allocates must hang off
+   mem_ctx, which is freed after the benchmark. run does one operation
+   and returns false on error.
+ */
+struct oc_bench_case {
+	const char	*name;
+	uint32_t	iterations;
+	bool		(*setup)(TALLOC_CTX *mem_ctx, void **state);
+	bool		(*run)(void *state);
+};
+
+struct oc_bench_suite {
+	const char			*name;
+	const struct oc_bench_case	*cases;
+	uint32_t			count;
+};
+
+#define	OC_BENCH_SUITE(n, c)	{ n, c, sizeof (c) / sizeof (c[0]) }
+
+__BEGIN_DECLS
+
+/* libmapi */
+const struct oc_bench_suite *libmapi_bench_suite(void);
+/* libmapiproxy */
+const struct oc_bench_suite *mapiproxy_bench_suite(void);
+/* libmapistore */
+const struct oc_bench_suite *mapistore_bench_suite(void);
+
+__END_DECLS
+
+#endif /*! __BENCH_H__ */
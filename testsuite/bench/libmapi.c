@@ -0,0 +1,342 @@
+/*
+   OpenChange Microbenchmarks
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include "libmapi/fxics.h"
+
+/* A mailbox worth of message identifiers, with the holes deletions
+   leave */
+#define	IDSET_BENCH_COUNT	10000
+#define	IDSET_BENCH_GUID	"9bb9ffb5-0f44-774f-b488-c5c6702ee3a8"
+
+#define	RTF_BENCH_SIZE		16384
+
+/* Message properties in a fast transfer stream and the size of the
+   buffers it is fed in, as FXGetBuffer returns them */
+#define	FXPARSER_BENCH_PROPS	2000
+#define	FXPARSER_BENCH_BUFFER	0x8000
+
+/* A large QueryRows response, as EcDoRpcExt2 compresses it */
+#define	LZXPRESS_BENCH_SIZE	0x8000
+
+struct idset_bench {
+	struct idset	*idset;
+	struct idset	*other;
+	DATA_BLOB	blob;
+};
+
+struct rtf_bench {
+	TALLOC_CTX	*mem_ctx;
+	char		*rtf;
+	size_t		rtf_size;
+	uint8_t		*comp;
+	size_t		comp_size;
+};
+
+struct fxparser_bench {
+	TALLOC_CTX	*mem_ctx;
+	DATA_BLOB	stream;
+};
+
+struct lzxpress_bench {
+	TALLOC_CTX	*mem_ctx;
+	DATA_BLOB	plain;
+};
+
+/* idset */
+
+static struct idset *idset_bench_make(TALLOC_CTX *mem_ctx, uint64_t first, uint32_t step)
+{
+	struct rawidset	*rawidset;
+	struct GUID	guid;
+	uint64_t	globcnt;
+	uint32_t	i;
+
+	GUID_from_string(IDSET_BENCH_GUID, &guid);
+	rawidset = RAWIDSET_make(mem_ctx, false, false);
+	for (i = 0, globcnt = first; i < IDSET_BENCH_COUNT; i++, globcnt++) {
+		/* one message out of step was deleted */
+		if (step && (i % step) == 0) continue;
+		RAWIDSET_push_guid_glob(rawidset, &guid, globcnt);
+	}
+
+	return RAWIDSET_convert_to_idset(mem_ctx, rawidset);
+}
+
+static bool idset_bench_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	struct idset_bench	*b;
+	struct Binary_r		*bin;
+
+	b = talloc_zero(mem_ctx, struct idset_bench);
+	b->idset = idset_bench_make(b, 0x100, 7);
+	b->other = idset_bench_make(b, 0x100 + IDSET_BENCH_COUNT / 2, 5);
+	if (!b->idset || !b->other) return false;
+
+	bin = IDSET_serialize(b, b->idset);
+	if (!bin) return false;
+	b->blob.data = bin->lpb;
+	b->blob.length = bin->cb;
+
+	*state = b;
+	return true;
+}
+
+static bool idset_bench_parse(void *state)
+{
+	struct idset_bench	*b = (struct idset_bench *) state;
+	struct idset		*idset;
+
+	idset = IDSET_parse(b, b->blob, false);
+	talloc_free(idset);
+
+	return (idset != NULL);
+}
+
+static bool idset_bench_serialize(void *state)
+{
+	struct idset_bench	*b = (struct idset_bench *) state;
+	struct Binary_r		*bin;
+
+	bin = IDSET_serialize(b, b->idset);
+	talloc_free(bin);
+
+	return (bin != NULL);
+}
+
+static bool idset_bench_merge(void *state)
+{
+	struct idset_bench	*b = (struct idset_bench *) state;
+	struct idset		*idset;
+
+	idset = IDSET_merge_idsets(b, b->idset, b->other);
+	talloc_free(idset);
+
+	return (idset != NULL);
+}
+
+/* lzfu */
+
+static bool rtf_bench_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	struct rtf_bench	*b;
+	char			*rtf;
+	uint32_t		i;
+
+	b = talloc_zero(mem_ctx, struct rtf_bench);
+	b->mem_ctx = b;
+
+	rtf = talloc_strdup(b, "{\\rtf1\\ansi\\ansicpg1252\\fromtext \\fbidis \\deff0"
+			    "{\\fonttbl{\\f0\\fswiss Arial;}{\\f1\\fmodern Courier New;}}\r\n"
+			    "{\\colortbl\\red0\\green0\\blue0;\\red0\\green0\\blue255;}\r\n");
+	for (i = 0; talloc_get_size(rtf) < RTF_BENCH_SIZE; i++) {
+		rtf = talloc_asprintf_append(rtf, "\\pard\\plain\\f0\\fs20 Line %u of the "
+					     "message body, with {\\b some} formatting\\par\r\n", i);
+	}
+	rtf = talloc_strdup_append(rtf, "}\r\n");
+	b->rtf = rtf;
+	b->rtf_size = strlen(rtf);
+
+	if (compress_rtf(b, b->rtf, b->rtf_size, &b->comp, &b->comp_size) != MAPI_E_SUCCESS) {
+		return false;
+	}
+
+	*state = b;
+	return true;
+}
+
+static bool rtf_bench_compress(void *state)
+{
+	struct rtf_bench	*b = (struct rtf_bench *) state;
+	uint8_t			*comp;
+	size_t			comp_size;
+
+	if (compress_rtf(b->mem_ctx, b->rtf, b->rtf_size, &comp, &comp_size) != MAPI_E_SUCCESS) {
+		return false;
+	}
+	talloc_free(comp);
+
+	return true;
+}
+
+static bool rtf_bench_uncompress(void *state)
+{
+	struct rtf_bench	*b = (struct rtf_bench *) state;
+	DATA_BLOB		uncomp;
+
+	if (uncompress_rtf(b->mem_ctx, b->comp, b->comp_size, &uncomp) != MAPI_E_SUCCESS) {
+		return false;
+	}
+	talloc_free(uncomp.data);
+
+	return true;
+}
+
+/* fxparser */
+
+static void fxparser_bench_push_uint32(struct fxparser_bench *b, uint32_t val)
+{
+	uint8_t	buf[4];
+
+	buf[0] = val & 0xFF;
+	buf[1] = (val >> 8) & 0xFF;
+	buf[2] = (val >> 16) & 0xFF;
+	buf[3] = (val >> 24) & 0xFF;
+	data_blob_append(b->mem_ctx, &b->stream, buf, 4);
+}
+
+static void fxparser_bench_push_counted(struct fxparser_bench *b, const void *data, uint32_t length)
+{
+	fxparser_bench_push_uint32(b, length);
+	data_blob_append(b->mem_ctx, &b->stream, data, length);
+}
+
+static enum MAPISTATUS fxparser_bench_property(struct SPropValue prop, void *priv)
+{
+	return MAPI_E_SUCCESS;
+}
+
+static bool fxparser_bench_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	const uint8_t		subject[] = { 'S', 0, 'u', 0, 'b', 0, 'j', 0, 'e', 0, 'c', 0, 't', 0, 0, 0 };
+	struct fxparser_bench	*b;
+	uint8_t			binary[256];
+	uint32_t		i;
+
+	b = talloc_zero(mem_ctx, struct fxparser_bench);
+	b->mem_ctx = b;
+	b->stream = data_blob_talloc_named(b, NULL, 0, "fxparser bench stream");
+	for (i = 0; i < sizeof (binary); i++) {
+		binary[i] = i * 7;
+	}
+
+	/* Messages of a few fixed and counted properties each */
+	fxparser_bench_push_uint32(b, StartTopFld);
+	for (i = 0; i < FXPARSER_BENCH_PROPS / 4; i++) {
+		fxparser_bench_push_uint32(b, StartMessage);
+		fxparser_bench_push_uint32(b, PidTagMessageSize);
+		fxparser_bench_push_uint32(b, 0x1000 + i);
+		fxparser_bench_push_uint32(b, PidTagSubject);
+		fxparser_bench_push_counted(b, subject, sizeof (subject));
+		fxparser_bench_push_uint32(b, (PidTagMessageClass & 0xFFFF0000) | PT_STRING8);
+		fxparser_bench_push_counted(b, "IPM.Note", 8);
+		fxparser_bench_push_uint32(b, PidTagRtfCompressed);
+		fxparser_bench_push_counted(b, binary, sizeof (binary));
+		fxparser_bench_push_uint32(b, EndMessage);
+	}
+	fxparser_bench_push_uint32(b, EndFolder);
+
+	*state = b;
+	return true;
+}
+
+static bool fxparser_bench_parse(void *state)
+{
+	struct fxparser_bench		*b = (struct fxparser_bench *) state;
+	TALLOC_CTX			*mem_ctx;
+	struct fx_parser_context	*parser;
+	DATA_BLOB			buffer;
+	uint32_t			offset;
+	enum MAPISTATUS			retval = MAPI_E_SUCCESS;
+
+	mem_ctx = talloc_new(b);
+	parser = fxparser_init(mem_ctx, NULL);
+	fxparser_set_property_callback(parser, fxparser_bench_property);
+	for (offset = 0; retval == MAPI_E_SUCCESS && offset < b->stream.length; offset += buffer.length) {
+		buffer.data = b->stream.data + offset;
+		buffer.length = b->stream.length - offset;
+		if (buffer.length > FXPARSER_BENCH_BUFFER) {
+			buffer.length = FXPARSER_BENCH_BUFFER;
+		}
+		retval = fxparser_parse(parser, &buffer);
+	}
+	talloc_free(mem_ctx);
+
+	return (retval == MAPI_E_SUCCESS);
+}
+
+/* lzxpress */
+
+static bool lzxpress_bench_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	const char		*subjects[] = { "Weekly status", "Re: Budget 2015", "Lunch",
+						"Fwd: Meeting notes", "Invitation: Review" };
+	struct lzxpress_bench	*b;
+	uint8_t			*data;
+	uint32_t		offset = 0;
+	uint32_t		row = 0;
+	const char		*s;
+
+	b = talloc_zero(mem_ctx, struct lzxpress_bench);
+	b->mem_ctx = b;
+	b->plain = data_blob_talloc_named(b, NULL, LZXPRESS_BENCH_SIZE, "lzxpress bench rows");
+	if (!b->plain.data) return false;
+
+	/* Rows of identifiers, flags and UTF-16 subjects */
+	data = b->plain.data;
+	while (offset + 64 < LZXPRESS_BENCH_SIZE) {
+		memset(data + offset, 0, 12);
+		data[offset] = 0x01;
+		memcpy(data + offset + 4, &row, sizeof (row));
+		offset += 12;
+		for (s = subjects[row % 5]; *s; s++) {
+			data[offset++] = *s;
+			data[offset++] = 0;
+		}
+		data[offset++] = 0;
+		data[offset++] = 0;
+		row++;
+	}
+	memset(data + offset, 0, LZXPRESS_BENCH_SIZE - offset);
+
+	*state = b;
+	return true;
+}
+
+static bool lzxpress_bench_compress(void *state)
+{
+	struct lzxpress_bench	*b = (struct lzxpress_bench *) state;
+	DATA_BLOB		comp;
+
+	if (!lzxpress_compress_blob(b->mem_ctx, &b->plain, &comp)) {
+		return false;
+	}
+	talloc_free(comp.data);
+
+	return true;
+}
+
+static const struct oc_bench_case libmapi_bench_cases[] = {
+	{ "idset/parse",		200,	idset_bench_setup,	idset_bench_parse },
+	{ "idset/serialize",		200,	idset_bench_setup,	idset_bench_serialize },
+	{ "idset/merge",		200,	idset_bench_setup,	idset_bench_merge },
+	{ "lzfu/compress_rtf",		200,	rtf_bench_setup,	rtf_bench_compress },
+	{ "lzfu/uncompress_rtf",	2000,	rtf_bench_setup,	rtf_bench_uncompress },
+	{ "fxparser/parse",		200,	fxparser_bench_setup,	fxparser_bench_parse },
+	{ "lzxpress/compress",		200,	lzxpress_bench_setup,	lzxpress_bench_compress }
+};
+
+static const struct oc_bench_suite libmapi_suite = OC_BENCH_SUITE("libmapi", libmapi_bench_cases);
+
+const struct oc_bench_suite *libmapi_bench_suite(void)
+{
+	return &libmapi_suite;
+}
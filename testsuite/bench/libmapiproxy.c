@@ -0,0 +1,103 @@
+/*
+   OpenChange Microbenchmarks
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+
+/* Handles a busy session keeps open: folders, tables and messages */
+#define	HANDLES_BENCH_COUNT	4096
+
+struct handles_bench {
+	struct mapi_handles_context	*handles_ctx;
+	uint32_t			root;
+	uint32_t			seed;
+};
+
+static bool handles_bench_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	struct handles_bench	*b;
+	struct mapi_handles	*rec;
+	uint32_t		i;
+
+	b = talloc_zero(mem_ctx, struct handles_bench);
+	b->handles_ctx = mapi_handles_init(b);
+	if (!b->handles_ctx) return false;
+
+	if (mapi_handles_add(b->handles_ctx, 0, &rec) != MAPI_E_SUCCESS) return false;
+	b->root = rec->handle;
+	for (i = 1; i < HANDLES_BENCH_COUNT; i++) {
+		if (mapi_handles_add(b->handles_ctx, b->root, &rec) != MAPI_E_SUCCESS) return false;
+	}
+	b->seed = 1;
+
+	*state = b;
+	return true;
+}
+
+/* a handle opened and released, as for a table or a message */
+static bool handles_bench_add(void *state)
+{
+	struct handles_bench	*b = (struct handles_bench *) state;
+	struct mapi_handles	*rec;
+
+	if (mapi_handles_add(b->handles_ctx, b->root, &rec) != MAPI_E_SUCCESS) return false;
+
+	return (mapi_handles_delete(b->handles_ctx, rec->handle) == MAPI_E_SUCCESS);
+}
+
+/* a folder released with the tables and messages opened from it */
+static bool handles_bench_release_tree(void *state)
+{
+	struct handles_bench	*b = (struct handles_bench *) state;
+	struct mapi_handles	*folder;
+	struct mapi_handles	*rec;
+	uint32_t		i;
+
+	if (mapi_handles_add(b->handles_ctx, b->root, &folder) != MAPI_E_SUCCESS) return false;
+	for (i = 0; i < 64; i++) {
+		if (mapi_handles_add(b->handles_ctx, folder->handle, &rec) != MAPI_E_SUCCESS) return false;
+	}
+
+	return (mapi_handles_delete(b->handles_ctx, folder->handle) == MAPI_E_SUCCESS);
+}
+
+static bool handles_bench_search(void *state)
+{
+	struct handles_bench	*b = (struct handles_bench *) state;
+	struct mapi_handles	*rec;
+
+	/* the same pseudo random sequence of handles on every run */
+	b->seed = b->seed * 1103515245 + 12345;
+
+	return (mapi_handles_search(b->handles_ctx, b->root + (b->seed >> 16) % HANDLES_BENCH_COUNT,
+				    &rec) == MAPI_E_SUCCESS);
+}
+
+static const struct oc_bench_case mapiproxy_bench_cases[] = {
+	{ "handles/add",		1000000,	handles_bench_setup,	handles_bench_add },
+	{ "handles/release_tree",	10000,		handles_bench_setup,	handles_bench_release_tree },
+	{ "handles/search",		1000000,	handles_bench_setup,	handles_bench_search }
+};
+
+static const struct oc_bench_suite mapiproxy_suite = OC_BENCH_SUITE("libmapiproxy", mapiproxy_bench_cases);
+
+const struct oc_bench_suite *mapiproxy_bench_suite(void)
+{
+	return &mapiproxy_suite;
+}
@@ -0,0 +1,368 @@
+/*
+   OpenChange Microbenchmarks
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+#include "mapiproxy/libmapistore/backends/indexing_tdb.h"
+#include "mapiproxy/libmapistore/backends/indexing_mysql.h"
+#include "mapiproxy/libmapistore/backends/namedprops_backend.h"
+
+#include <unistd.h>
+#include <inttypes.h>
+#include <param.h>
+#include <mysql/mysql.h>
+
+/* The testsuite MySQL server, with databases of our own */
+#define	BENCH_MYSQL_HOST		"127.0.0.1"
+#define	BENCH_MYSQL_USER		"root"
+#define	BENCH_MYSQL_PASS		""
+#define	BENCH_INDEXING_MYSQL_DB		"openchange_bench_indexing"
+#define	BENCH_NAMEDPROPS_MYSQL_DB	"openchange_bench_namedprops"
+
+#define	BENCH_USERNAME			"benchuser"
+#define	BENCH_NAMEDPROPS_DATA		"setup/mapistore"
+
+/* Records in the indexing database, the first FMID and the URI
+   pattern of a mailbox */
+#define	INDEXING_BENCH_COUNT		10000
+#define	INDEXING_BENCH_FMID		0x100000001ULL
+#define	INDEXING_BENCH_URI		"bench://" BENCH_USERNAME "/inbox/%u.eml"
+
+enum bench_backend {
+	BENCH_BACKEND_TDB,
+	BENCH_BACKEND_MYSQL,
+	BENCH_BACKEND_LDB
+};
+
+struct indexing_bench {
+	struct mapistore_context	*mstore_ctx;
+	struct indexing_context		*ictx;
+	enum bench_backend		backend;
+	char				*dir;
+	char				**uris;
+	uint32_t			next;
+	uint64_t			next_fmid;
+};
+
+struct namedprops_bench {
+	struct namedprops_context	*nprops;
+	enum bench_backend		backend;
+	char				*dir;
+	uint32_t			next;
+};
+
+/* temporary directories */
+
+static char *bench_mkdtemp(TALLOC_CTX *mem_ctx)
+{
+	char	*dir;
+
+	dir = talloc_strdup(mem_ctx, "/tmp/openchange-bench-XXXXXX");
+	if (!mkdtemp(dir)) {
+		talloc_free(dir);
+		return NULL;
+	}
+
+	return dir;
+}
+
+static char *bench_mysql_connection_string(TALLOC_CTX *mem_ctx, const char *db)
+{
+	if (!strlen(BENCH_MYSQL_PASS)) {
+		return talloc_asprintf(mem_ctx, "mysql://%s@%s/%s", BENCH_MYSQL_USER,
+				       BENCH_MYSQL_HOST, db);
+	}
+
+	return talloc_asprintf(mem_ctx, "mysql://%s:%s@%s/%s", BENCH_MYSQL_USER,
+			       BENCH_MYSQL_PASS, BENCH_MYSQL_HOST, db);
+}
+
+static void bench_mysql_drop(MYSQL *conn, const char *db)
+{
+	char	sql[128];
+
+	if (!conn) return;
+	snprintf(sql, sizeof (sql), "DROP DATABASE %s", db);
+	mysql_query(conn, sql);
+}
+
+/* indexing */
+
+static int indexing_bench_destructor(struct indexing_bench *b)
+{
+	char	*path;
+
+	if (b->backend == BENCH_BACKEND_MYSQL) {
+		if (b->ictx) bench_mysql_drop(b->ictx->data, BENCH_INDEXING_MYSQL_DB);
+	} else if (b->dir) {
+		path = talloc_asprintf(b, "%s/%s/indexing.tdb", b->dir, BENCH_USERNAME);
+		unlink(path);
+		talloc_free(path);
+		path = talloc_asprintf(b, "%s/%s", b->dir, BENCH_USERNAME);
+		rmdir(path);
+		talloc_free(path);
+		rmdir(b->dir);
+	}
+
+	return 0;
+}
+
+static bool indexing_bench_setup(TALLOC_CTX *mem_ctx, enum bench_backend backend, void **state)
+{
+	struct indexing_bench	*b;
+	enum mapistore_error	retval;
+	char			*conn_string;
+	uint32_t		i;
+
+	b = talloc_zero(mem_ctx, struct indexing_bench);
+	b->backend = backend;
+	talloc_set_destructor(b, indexing_bench_destructor);
+
+	b->mstore_ctx = talloc_zero(b, struct mapistore_context);
+	if (backend == BENCH_BACKEND_MYSQL) {
+		conn_string = bench_mysql_connection_string(b, BENCH_INDEXING_MYSQL_DB);
+		retval = mapistore_indexing_mysql_init(b->mstore_ctx, BENCH_USERNAME, conn_string, &b->ictx);
+		if (retval != MAPISTORE_SUCCESS) b->ictx = NULL;
+	} else {
+		b->dir = bench_mkdtemp(b);
+		if (!b->dir) return false;
+		if (mapistore_set_mapping_path(b->dir) != MAPISTORE_SUCCESS) return false;
+		retval = mapistore_indexing_tdb_init(b->mstore_ctx, BENCH_USERNAME, &b->ictx);
+	}
+	if (retval != MAPISTORE_SUCCESS) return false;
+
+	b->uris = talloc_array(b, char *, INDEXING_BENCH_COUNT);
+	for (i = 0; i < INDEXING_BENCH_COUNT; i++) {
+		b->uris[i] = talloc_asprintf(b->uris, INDEXING_BENCH_URI, i);
+		retval = b->ictx->add_fmid(b->ictx, BENCH_USERNAME, INDEXING_BENCH_FMID + i, b->uris[i]);
+		if (retval != MAPISTORE_SUCCESS) return false;
+	}
+	b->next_fmid = INDEXING_BENCH_FMID + INDEXING_BENCH_COUNT;
+
+	*state = b;
+	return true;
+}
+
+static bool indexing_bench_tdb_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	return indexing_bench_setup(mem_ctx, BENCH_BACKEND_TDB, state);
+}
+
+static bool indexing_bench_mysql_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	return indexing_bench_setup(mem_ctx, BENCH_BACKEND_MYSQL, state);
+}
+
+/* a new message indexed in a large mailbox */
+static bool indexing_bench_add(void *state)
+{
+	struct indexing_bench	*b = (struct indexing_bench *) state;
+	char			uri[64];
+
+	snprintf(uri, sizeof (uri), "bench://" BENCH_USERNAME "/sent/%"PRIu64".eml", b->next_fmid);
+
+	return (b->ictx->add_fmid(b->ictx, BENCH_USERNAME, b->next_fmid++, uri) == MAPISTORE_SUCCESS);
+}
+
+static bool indexing_bench_get_uri(void *state)
+{
+	struct indexing_bench	*b = (struct indexing_bench *) state;
+	TALLOC_CTX		*mem_ctx;
+	enum mapistore_error	retval;
+	char			*uri;
+	bool			soft_deleted;
+
+	/* stride through the records rather than hitting the same one */
+	b->next = (b->next + 7919) % INDEXING_BENCH_COUNT;
+	mem_ctx = talloc_new(b);
+	retval = b->ictx->get_uri(b->ictx, BENCH_USERNAME, mem_ctx, INDEXING_BENCH_FMID + b->next,
+				  &uri, &soft_deleted);
+	talloc_free(mem_ctx);
+
+	return (retval == MAPISTORE_SUCCESS);
+}
+
+static bool indexing_bench_get_fmid(void *state)
+{
+	struct indexing_bench	*b = (struct indexing_bench *) state;
+	uint64_t		fmid;
+	bool			soft_deleted;
+
+	b->next = (b->next + 7919) % INDEXING_BENCH_COUNT;
+
+	return (b->ictx->get_fmid(b->ictx, BENCH_USERNAME, b->uris[b->next], false,
+				  &fmid, &soft_deleted) == MAPISTORE_SUCCESS);
+}
+
+/* named properties */
+
+/* Mappings of setup/mapistore/mapistore_namedprops.ldif, as the
+   testsuite checks them */
+static const struct {
+	uint32_t	time_low;
+	uint32_t	lid;
+	const char	*name;
+	uint16_t	mapped_id;
+} namedprops_bench_ids[] = {
+	{ 0x62003,	33026,	NULL,						37153 },
+	{ 0x62004,	32978,	NULL,						37524 },
+	{ 0x62004,	32901,	NULL,						37297 },
+	{ 0x20329,	0,	"http://schemas.microsoft.com/exchange/smallicon",	38342 },
+	{ 0x20329,	0,	"http://schemas.microsoft.com/exchange/searchfolder",	38365 }
+};
+
+#define	NAMEDPROPS_BENCH_IDS	(sizeof (namedprops_bench_ids) / sizeof (namedprops_bench_ids[0]))
+
+static int namedprops_bench_destructor(struct namedprops_bench *b)
+{
+	char	*path;
+
+	if (b->backend == BENCH_BACKEND_MYSQL) {
+		if (b->nprops) bench_mysql_drop(b->nprops->data, BENCH_NAMEDPROPS_MYSQL_DB);
+	} else if (b->dir) {
+		path = talloc_asprintf(b, "%s/namedprops.ldb", b->dir);
+		unlink(path);
+		talloc_free(path);
+		rmdir(b->dir);
+	}
+
+	return 0;
+}
+
+static bool namedprops_bench_setup(TALLOC_CTX *mem_ctx, enum bench_backend backend, bool cache, void **state)
+{
+	struct namedprops_bench		*b;
+	struct loadparm_context		*lp_ctx;
+	char				*path;
+
+	b = talloc_zero(mem_ctx, struct namedprops_bench);
+	b->backend = backend;
+	talloc_set_destructor(b, namedprops_bench_destructor);
+
+	lp_ctx = loadparm_init(b);
+	if (!lp_ctx) return false;
+
+	lpcfg_set_cmdline(lp_ctx, "namedproperties:cache", cache ? "true" : "false");
+	if (backend == BENCH_BACKEND_MYSQL) {
+		lpcfg_set_cmdline(lp_ctx, "mapistore:namedproperties", "mysql");
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:mysql_data", BENCH_NAMEDPROPS_DATA);
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:mysql_host", BENCH_MYSQL_HOST);
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:mysql_user", BENCH_MYSQL_USER);
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:mysql_pass", BENCH_MYSQL_PASS);
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:mysql_port", "3306");
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:mysql_db", BENCH_NAMEDPROPS_MYSQL_DB);
+	} else {
+		b->dir = bench_mkdtemp(b);
+		if (!b->dir) return false;
+		path = talloc_asprintf(b, "%s/namedprops.ldb", b->dir);
+		lpcfg_set_cmdline(lp_ctx, "mapistore:namedproperties", "ldb");
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:ldb_url", path);
+		lpcfg_set_cmdline(lp_ctx, "namedproperties:ldb_data", BENCH_NAMEDPROPS_DATA);
+	}
+
+	if (mapistore_namedprops_init(b, lp_ctx, &b->nprops) != MAPISTORE_SUCCESS) {
+		b->nprops = NULL;
+		return false;
+	}
+
+	*state = b;
+	return true;
+}
+
+static bool namedprops_bench_ldb_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	return namedprops_bench_setup(mem_ctx, BENCH_BACKEND_LDB, false, state);
+}
+
+static bool namedprops_bench_mysql_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	return namedprops_bench_setup(mem_ctx, BENCH_BACKEND_MYSQL, false, state);
+}
+
+static bool namedprops_bench_cached_setup(TALLOC_CTX *mem_ctx, void **state)
+{
+	return namedprops_bench_setup(mem_ctx, BENCH_BACKEND_LDB, true, state);
+}
+
+static bool namedprops_bench_get_mapped_id(void *state)
+{
+	struct namedprops_bench	*b = (struct namedprops_bench *) state;
+	struct MAPINAMEID	nameid;
+	uint16_t		mapped_id;
+	uint32_t		i;
+
+	i = b->next++ % NAMEDPROPS_BENCH_IDS;
+	memset(&nameid, 0, sizeof (nameid));
+	nameid.lpguid.time_low = namedprops_bench_ids[i].time_low;
+	nameid.lpguid.clock_seq[0] = 0xc0;
+	nameid.lpguid.node[5] = 0x46;
+	if (namedprops_bench_ids[i].name) {
+		nameid.ulKind = MNID_STRING;
+		nameid.kind.lpwstr.Name = namedprops_bench_ids[i].name;
+	} else {
+		nameid.ulKind = MNID_ID;
+		nameid.kind.lid = namedprops_bench_ids[i].lid;
+	}
+
+	if (mapistore_namedprops_get_mapped_id(b->nprops, nameid, &mapped_id) != MAPISTORE_SUCCESS) {
+		return false;
+	}
+
+	return (mapped_id == namedprops_bench_ids[i].mapped_id);
+}
+
+static bool namedprops_bench_get_nameid(void *state)
+{
+	struct namedprops_bench	*b = (struct namedprops_bench *) state;
+	TALLOC_CTX		*mem_ctx;
+	struct MAPINAMEID	*nameid;
+	enum mapistore_error	retval;
+
+	mem_ctx = talloc_new(b);
+	retval = mapistore_namedprops_get_nameid(b->nprops,
+						 namedprops_bench_ids[b->next++ % NAMEDPROPS_BENCH_IDS].mapped_id,
+						 mem_ctx, &nameid);
+	talloc_free(mem_ctx);
+
+	return (retval == MAPISTORE_SUCCESS);
+}
+
+static const struct oc_bench_case mapistore_bench_cases[] = {
+	{ "indexing/tdb/add_fmid",		10000,		indexing_bench_tdb_setup,	indexing_bench_add },
+	{ "indexing/tdb/get_uri",		100000,		indexing_bench_tdb_setup,	indexing_bench_get_uri },
+	{ "indexing/tdb/get_fmid",		100000,		indexing_bench_tdb_setup,	indexing_bench_get_fmid },
+	{ "indexing/mysql/add_fmid",		1000,		indexing_bench_mysql_setup,	indexing_bench_add },
+	{ "indexing/mysql/get_uri",		5000,		indexing_bench_mysql_setup,	indexing_bench_get_uri },
+	{ "indexing/mysql/get_fmid",		5000,		indexing_bench_mysql_setup,	indexing_bench_get_fmid },
+	{ "namedprops/ldb/get_mapped_id",	20000,		namedprops_bench_ldb_setup,	namedprops_bench_get_mapped_id },
+	{ "namedprops/ldb/get_nameid",		20000,		namedprops_bench_ldb_setup,	namedprops_bench_get_nameid },
+	{ "namedprops/mysql/get_mapped_id",	5000,		namedprops_bench_mysql_setup,	namedprops_bench_get_mapped_id },
+	{ "namedprops/mysql/get_nameid",	5000,		namedprops_bench_mysql_setup,	namedprops_bench_get_nameid },
+	{ "namedprops/cached/get_mapped_id",	1000000,	namedprops_bench_cached_setup,	namedprops_bench_get_mapped_id },
+	{ "namedprops/cached/get_nameid",	1000000,	namedprops_bench_cached_setup,	namedprops_bench_get_nameid }
+};
+
+static const struct oc_bench_suite mapistore_suite = OC_BENCH_SUITE("libmapistore", mapistore_bench_cases);
+
+const struct oc_bench_suite *mapistore_bench_suite(void)
+{
+	return &mapistore_suite;
+}
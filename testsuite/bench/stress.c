@@ -0,0 +1,906 @@
+/*
+   OpenChange Stress Benchmarks
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+   Unlike openchange-bench, which times one operation at a time in a
+   single process, openchange-stress forks a number of workers which
+   run a mix of operations against the same backend for a given time,
+   the way the server processes of a busy deployment do. Each worker
+   has its own backend context, as a server process would, and records
+   the latency of every operation and the identifiers it allocated in
+   memory shared with the parent.
+
+   The parent then reports the throughput and the latency percentiles
+   of every operation, and the correctness violations: identifiers
+   allocated twice, lookups returning something else than what was
+   just stored, and workers which didn't finish in time, usually
+   because of a deadlock.
+
+   Backends are set up and torn down in a child of their own, so that
+   the parent never holds a connection or a database handle a worker
+   could inherit.
+ */
+
+#include "bench.h"
+#include "libmapi/libmapi.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "mapiproxy/libmapiproxy/backends/openchangedb_mysql.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/backends/indexing_tdb.h"
+#include "mapiproxy/libmapistore/backends/indexing_mysql.h"
+
+#include <stddef.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <popt.h>
+#include <param.h>
+#include <mysql/mysql.h>
+
+/* The testsuite MySQL server, with databases of our own */
+#define	STRESS_MYSQL_HOST		"127.0.0.1"
+#define	STRESS_MYSQL_USER		"root"
+#define	STRESS_MYSQL_PASS		""
+#define	STRESS_OPENCHANGEDB_MYSQL_DB	"openchange_stress_openchangedb"
+#define	STRESS_INDEXING_MYSQL_DB	"openchange_stress_indexing"
+
+#define	STRESS_INDEXING_USERNAME	"stressuser"
+#define	STRESS_INDEXING_URI		"stress://" STRESS_INDEXING_USERNAME "/w%u/%"PRIu64".eml"
+
+/* The mailbox of the openchangedb sample data, the folder new folders
+   are created in and the system folders read */
+#define	STRESS_OPENCHANGEDB_SAMPLE_SQL	"testsuite/resources/openchangedb_sample.sql"
+#define	STRESS_OPENCHANGEDB_USERNAME	"paco"
+#define	STRESS_OPENCHANGEDB_PARENT_FID	18231415716525899777ULL
+#define	STRESS_OPENCHANGEDB_URI		"stress://" STRESS_OPENCHANGEDB_USERNAME "/w%u/%"PRIu64"/"
+#define	STRESS_SYSTEM_FOLDERS		4
+
+#define	STRESS_WORKERS			8
+#define	STRESS_MAX_WORKERS		64
+#define	STRESS_DURATION			10
+/* Seconds a worker is given on top of the duration before it is
+   considered stalled and killed */
+#define	STRESS_GRACE			30
+/* Identifiers recorded per worker for the duplicate check */
+#define	STRESS_MAX_IDS			(1 << 18)
+#define	STRESS_MAX_OPS			8
+/* Latency buckets: four per power of two of nanoseconds */
+#define	STRESS_BUCKETS			(4 * 40)
+
+#define	STRESS_SETUP_SKIPPED		2
+
+struct stress_op_stats {
+	uint64_t	count;
+	uint64_t	errors;
+	uint64_t	max_ns;
+	uint64_t	buckets[STRESS_BUCKETS];
+};
+
+struct stress_worker {
+	struct stress_op_stats	ops[STRESS_MAX_OPS];
+	uint64_t		violations;
+	uint64_t		ids_count;
+	uint64_t		ids[STRESS_MAX_IDS];
+};
+
+struct stress_shared {
+	/* Values the workers compare their lookups to, set by setup */
+	uint64_t		expected[STRESS_SYSTEM_FOLDERS];
+	char			dir[64];
+	struct stress_worker	workers[1];
+};
+
+struct stress_worker_ctx {
+	struct stress_shared	*shared;
+	struct stress_worker	*stats;
+	uint32_t		worker;
+	uint64_t		seq;
+	void			*backend;
+};
+
+/**
+   One stress benchmark
+
+   setup creates the backend in the setup child and returns false when
+   it can't run here (e.g. no MySQL server). open gives a worker its
+   own context, step runs one round of the mix, recording its
+   operations with stress_account, and teardown removes the backend.
+ */
+struct stress_case {
+	const char	*name;
+	const char	*ops[STRESS_MAX_OPS];
+	const char	*ids;
+	bool		(*setup)(TALLOC_CTX *, struct stress_shared *);
+	bool		(*open)(TALLOC_CTX *, struct stress_worker_ctx *);
+	void		(*step)(TALLOC_CTX *, struct stress_worker_ctx *);
+	void		(*teardown)(TALLOC_CTX *, struct stress_shared *);
+};
+
+static uint64_t stress_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint32_t stress_bucket(uint64_t ns)
+{
+	uint32_t	msb;
+	uint32_t	bucket;
+
+	if (ns < 4) return ns;
+
+	msb = 63 - __builtin_clzll(ns);
+	bucket = msb * 4 + ((ns >> (msb - 2)) & 3);
+
+	return (bucket < STRESS_BUCKETS) ? bucket : STRESS_BUCKETS - 1;
+}
+
+/* The largest latency accounted in a bucket */
+static uint64_t stress_bucket_max(uint32_t bucket)
+{
+	uint32_t	msb = bucket / 4;
+
+	if (bucket < 4) return bucket;
+
+	return ((uint64_t) (4 + (bucket & 3) + 1) << (msb - 2)) - 1;
+}
+
+static void stress_account(struct stress_worker_ctx *w, uint32_t op, uint64_t start, bool ok)
+{
+	struct stress_op_stats	*s = &w->stats->ops[op];
+	uint64_t		ns = stress_now() - start;
+
+	s->count++;
+	if (!ok) s->errors++;
+	if (ns > s->max_ns) s->max_ns = ns;
+	s->buckets[stress_bucket(ns)]++;
+}
+
+/* Record an allocated identifier for the duplicate check */
+static void stress_record_id(struct stress_worker_ctx *w, uint64_t id)
+{
+	if (w->stats->ids_count < STRESS_MAX_IDS) {
+		w->stats->ids[w->stats->ids_count++] = id;
+	}
+}
+
+static void stress_violation(struct stress_worker_ctx *w, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
+
+static void stress_violation(struct stress_worker_ctx *w, const char *fmt, ...)
+{
+	va_list	ap;
+
+	/* Only the first few, the count tells the rest */
+	if (w->stats->violations++ < 5) {
+		fprintf(stderr, "[VIOLATION] worker %u: ", w->worker);
+		va_start(ap, fmt);
+		vfprintf(stderr, fmt, ap);
+		va_end(ap);
+		fprintf(stderr, "\n");
+	}
+}
+
+/* MySQL */
+
+static char *stress_mysql_connection_string(TALLOC_CTX *mem_ctx, const char *db)
+{
+	if (!strlen(STRESS_MYSQL_PASS)) {
+		return talloc_asprintf(mem_ctx, "mysql://%s@%s/%s", STRESS_MYSQL_USER,
+				       STRESS_MYSQL_HOST, db);
+	}
+
+	return talloc_asprintf(mem_ctx, "mysql://%s:%s@%s/%s", STRESS_MYSQL_USER,
+			       STRESS_MYSQL_PASS, STRESS_MYSQL_HOST, db);
+}
+
+static void stress_mysql_drop(const char *db)
+{
+	MYSQL	*conn;
+	char	sql[128];
+
+	conn = mysql_init(NULL);
+	if (!conn) return;
+	if (mysql_real_connect(conn, STRESS_MYSQL_HOST, STRESS_MYSQL_USER, STRESS_MYSQL_PASS,
+			       NULL, 0, NULL, 0)) {
+		snprintf(sql, sizeof (sql), "DROP DATABASE IF EXISTS %s", db);
+		mysql_query(conn, sql);
+	}
+	mysql_close(conn);
+}
+
+/* openchangedb */
+
+/* The mailbox root and the system folders the testsuite checks */
+static const uint32_t openchangedb_stress_system_idx[STRESS_SYSTEM_FOLDERS] = { 0x1, 0x2, 0xe, 0xf };
+
+enum {
+	OPENCHANGEDB_STRESS_CN,
+	OPENCHANGEDB_STRESS_SYSTEM_FID,
+	OPENCHANGEDB_STRESS_CREATE,
+	OPENCHANGEDB_STRESS_GET_URI,
+	OPENCHANGEDB_STRESS_GET_FID,
+	OPENCHANGEDB_STRESS_DELETE
+};
+
+static struct loadparm_context *openchangedb_stress_lp_ctx(TALLOC_CTX *mem_ctx)
+{
+	struct loadparm_context	*lp_ctx;
+	char			*conn_string;
+
+	lp_ctx = loadparm_init(mem_ctx);
+	if (!lp_ctx) return NULL;
+
+	conn_string = stress_mysql_connection_string(mem_ctx, STRESS_OPENCHANGEDB_MYSQL_DB);
+	if (!lpcfg_set_cmdline(lp_ctx, "mapiproxy:openchangedb", conn_string)) return NULL;
+
+	return lp_ctx;
+}
+
+static bool openchangedb_stress_load(TALLOC_CTX *mem_ctx, MYSQL *conn, const char *path)
+{
+	FILE		*f;
+	long		size;
+	char		*sql;
+	char		*insert;
+
+	f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "[ERROR] Unable to open %s\n", path);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+
+	sql = talloc_zero_array(mem_ctx, char, size + 1);
+	if (!sql || fread(sql, sizeof (char), size, f) != size) {
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+
+	for (insert = strtok(sql, ";"); insert && strlen(insert) > 10; insert = strtok(NULL, ";")) {
+		if (mysql_query(conn, insert)) {
+			fprintf(stderr, "[ERROR] %s\n\t%s\n", mysql_error(conn), insert);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool openchangedb_stress_setup(TALLOC_CTX *mem_ctx, struct stress_shared *shared)
+{
+	struct loadparm_context		*lp_ctx;
+	struct openchangedb_context	*oc_ctx;
+	uint32_t			i;
+
+	lp_ctx = openchangedb_stress_lp_ctx(mem_ctx);
+	if (!lp_ctx) return false;
+
+	if (openchangedb_mysql_initialize(mem_ctx, lp_ctx, &oc_ctx) != MAPI_E_SUCCESS) {
+		return false;
+	}
+
+	if (!openchangedb_stress_load(mem_ctx, oc_ctx->data, STRESS_OPENCHANGEDB_SAMPLE_SQL)) {
+		return false;
+	}
+
+	for (i = 0; i < STRESS_SYSTEM_FOLDERS; i++) {
+		if (openchangedb_get_SystemFolderID(oc_ctx, STRESS_OPENCHANGEDB_USERNAME,
+						    openchangedb_stress_system_idx[i],
+						    &shared->expected[i]) != MAPI_E_SUCCESS) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool openchangedb_stress_open(TALLOC_CTX *mem_ctx, struct stress_worker_ctx *w)
+{
+	struct loadparm_context		*lp_ctx;
+	struct openchangedb_context	*oc_ctx;
+
+	lp_ctx = openchangedb_stress_lp_ctx(mem_ctx);
+	if (!lp_ctx) return false;
+
+	if (openchangedb_mysql_initialize(mem_ctx, lp_ctx, &oc_ctx) != MAPI_E_SUCCESS) {
+		return false;
+	}
+	w->backend = oc_ctx;
+
+	return true;
+}
+
+/* What a client creating a folder and browsing its mailbox costs:
+   a change number, system folder lookups, and a folder created,
+   resolved both ways and deleted */
+static void openchangedb_stress_step(TALLOC_CTX *mem_ctx, struct stress_worker_ctx *w)
+{
+	struct openchangedb_context	*oc_ctx = (struct openchangedb_context *) w->backend;
+	enum MAPISTATUS			retval;
+	uint64_t			start;
+	uint64_t			cn = 0;
+	uint64_t			fid;
+	uint64_t			found_fid;
+	uint32_t			i;
+	char				*uri;
+	char				*found_uri;
+
+	start = stress_now();
+	retval = openchangedb_get_new_changeNumber(oc_ctx, STRESS_OPENCHANGEDB_USERNAME, &cn);
+	stress_account(w, OPENCHANGEDB_STRESS_CN, start, retval == MAPI_E_SUCCESS);
+	if (retval != MAPI_E_SUCCESS) return;
+	stress_record_id(w, cn);
+
+	for (i = 0; i < STRESS_SYSTEM_FOLDERS; i++) {
+		start = stress_now();
+		retval = openchangedb_get_SystemFolderID(oc_ctx, STRESS_OPENCHANGEDB_USERNAME,
+							 openchangedb_stress_system_idx[i], &fid);
+		stress_account(w, OPENCHANGEDB_STRESS_SYSTEM_FID, start, retval == MAPI_E_SUCCESS);
+		if (retval == MAPI_E_SUCCESS && fid != w->shared->expected[i]) {
+			stress_violation(w, "system folder 0x%x is 0x%"PRIx64" instead of 0x%"PRIx64,
+					 openchangedb_stress_system_idx[i], fid, w->shared->expected[i]);
+		}
+	}
+
+	/* A folder identifier of the worker's own, so that duplicate
+	   change numbers show up as violations rather than as folder
+	   creation errors */
+	fid = (((uint64_t) (w->worker + 1) << 40 | w->seq++) << 16) | 0x0001;
+	uri = talloc_asprintf(mem_ctx, STRESS_OPENCHANGEDB_URI, w->worker, fid);
+
+	start = stress_now();
+	retval = openchangedb_create_folder(oc_ctx, STRESS_OPENCHANGEDB_USERNAME, STRESS_OPENCHANGEDB_PARENT_FID,
+					    fid, cn, uri, -1);
+	stress_account(w, OPENCHANGEDB_STRESS_CREATE, start, retval == MAPI_E_SUCCESS);
+	if (retval != MAPI_E_SUCCESS) return;
+
+	start = stress_now();
+	retval = openchangedb_get_mapistoreURI(mem_ctx, oc_ctx, STRESS_OPENCHANGEDB_USERNAME, fid, &found_uri, true);
+	stress_account(w, OPENCHANGEDB_STRESS_GET_URI, start, retval == MAPI_E_SUCCESS);
+	if (retval == MAPI_E_SUCCESS && strcmp(found_uri, uri)) {
+		stress_violation(w, "folder 0x%"PRIx64" has URI %s instead of %s", fid, found_uri, uri);
+	}
+
+	start = stress_now();
+	retval = openchangedb_get_fid(oc_ctx, uri, &found_fid);
+	stress_account(w, OPENCHANGEDB_STRESS_GET_FID, start, retval == MAPI_E_SUCCESS);
+	if (retval == MAPI_E_SUCCESS && found_fid != fid) {
+		stress_violation(w, "URI %s is folder 0x%"PRIx64" instead of 0x%"PRIx64, uri, found_fid, fid);
+	}
+
+	start = stress_now();
+	retval = openchangedb_delete_folder(oc_ctx, STRESS_OPENCHANGEDB_USERNAME, fid);
+	stress_account(w, OPENCHANGEDB_STRESS_DELETE, start, retval == MAPI_E_SUCCESS);
+	if (retval == MAPI_E_SUCCESS && openchangedb_get_fid(oc_ctx, uri, &found_fid) == MAPI_E_SUCCESS) {
+		stress_violation(w, "folder 0x%"PRIx64" still found after deletion", fid);
+	}
+}
+
+static void openchangedb_stress_teardown(TALLOC_CTX *mem_ctx, struct stress_shared *shared)
+{
+	stress_mysql_drop(STRESS_OPENCHANGEDB_MYSQL_DB);
+}
+
+/* indexing */
+
+enum {
+	INDEXING_STRESS_ALLOCATE,
+	INDEXING_STRESS_ADD,
+	INDEXING_STRESS_GET_URI,
+	INDEXING_STRESS_GET_FMID,
+	INDEXING_STRESS_DELETE
+};
+
+static bool indexing_stress_open_backend(TALLOC_CTX *mem_ctx, struct stress_shared *shared, bool mysql,
+					 struct indexing_context **ictxp)
+{
+	struct mapistore_context	*mstore_ctx;
+	char				*conn_string;
+
+	mstore_ctx = talloc_zero(mem_ctx, struct mapistore_context);
+	if (!mstore_ctx) return false;
+
+	if (mysql) {
+		conn_string = stress_mysql_connection_string(mem_ctx, STRESS_INDEXING_MYSQL_DB);
+		return (mapistore_indexing_mysql_init(mstore_ctx, STRESS_INDEXING_USERNAME, conn_string,
+						      ictxp) == MAPISTORE_SUCCESS);
+	}
+
+	if (mapistore_set_mapping_path(shared->dir) != MAPISTORE_SUCCESS) return false;
+
+	return (mapistore_indexing_tdb_init(mstore_ctx, STRESS_INDEXING_USERNAME, ictxp) == MAPISTORE_SUCCESS);
+}
+
+static bool indexing_stress_tdb_setup(TALLOC_CTX *mem_ctx, struct stress_shared *shared)
+{
+	struct indexing_context	*ictx;
+
+	strncpy(shared->dir, "/tmp/openchange-stress-XXXXXX", sizeof (shared->dir) - 1);
+	if (!mkdtemp(shared->dir)) return false;
+
+	return indexing_stress_open_backend(mem_ctx, shared, false, &ictx);
+}
+
+static bool indexing_stress_mysql_setup(TALLOC_CTX *mem_ctx, struct stress_shared *shared)
+{
+	struct indexing_context	*ictx;
+
+	return indexing_stress_open_backend(mem_ctx, shared, true, &ictx);
+}
+
+static bool indexing_stress_tdb_open(TALLOC_CTX *mem_ctx, struct stress_worker_ctx *w)
+{
+	return indexing_stress_open_backend(mem_ctx, w->shared, false, (struct indexing_context **) &w->backend);
+}
+
+static bool indexing_stress_mysql_open(TALLOC_CTX *mem_ctx, struct stress_worker_ctx *w)
+{
+	return indexing_stress_open_backend(mem_ctx, w->shared, true, (struct indexing_context **) &w->backend);
+}
+
+/* What delivering and reading a message costs: an FMID allocated and
+   indexed, resolved both ways, and half of the messages deleted so the
+   index keeps growing */
+static void indexing_stress_step(TALLOC_CTX *mem_ctx, struct stress_worker_ctx *w)
+{
+	struct indexing_context	*ictx = (struct indexing_context *) w->backend;
+	enum mapistore_error	retval;
+	uint64_t		start;
+	uint64_t		fmid = 0;
+	uint64_t		found_fmid;
+	bool			soft_deleted;
+	char			*uri;
+	char			*found_uri;
+
+	start = stress_now();
+	retval = ictx->allocate_fmid(ictx, STRESS_INDEXING_USERNAME, &fmid);
+	stress_account(w, INDEXING_STRESS_ALLOCATE, start, retval == MAPISTORE_SUCCESS);
+	if (retval != MAPISTORE_SUCCESS) return;
+	stress_record_id(w, fmid);
+
+	uri = talloc_asprintf(mem_ctx, STRESS_INDEXING_URI, w->worker, fmid);
+
+	start = stress_now();
+	retval = ictx->add_fmid(ictx, STRESS_INDEXING_USERNAME, fmid, uri);
+	stress_account(w, INDEXING_STRESS_ADD, start, retval == MAPISTORE_SUCCESS);
+	if (retval != MAPISTORE_SUCCESS) return;
+
+	start = stress_now();
+	retval = ictx->get_uri(ictx, STRESS_INDEXING_USERNAME, mem_ctx, fmid, &found_uri, &soft_deleted);
+	stress_account(w, INDEXING_STRESS_GET_URI, start, retval == MAPISTORE_SUCCESS);
+	if (retval == MAPISTORE_SUCCESS && strcmp(found_uri, uri)) {
+		stress_violation(w, "FMID 0x%"PRIx64" has URI %s instead of %s", fmid, found_uri, uri);
+	}
+
+	start = stress_now();
+	retval = ictx->get_fmid(ictx, STRESS_INDEXING_USERNAME, uri, false, &found_fmid, &soft_deleted);
+	stress_account(w, INDEXING_STRESS_GET_FMID, start, retval == MAPISTORE_SUCCESS);
+	if (retval == MAPISTORE_SUCCESS && found_fmid != fmid) {
+		stress_violation(w, "URI %s is FMID 0x%"PRIx64" instead of 0x%"PRIx64, uri, found_fmid, fmid);
+	}
+
+	if (w->seq++ & 1) return;
+
+	start = stress_now();
+	retval = ictx->del_fmid(ictx, STRESS_INDEXING_USERNAME, fmid, MAPISTORE_PERMANENT_DELETE);
+	stress_account(w, INDEXING_STRESS_DELETE, start, retval == MAPISTORE_SUCCESS);
+	if (retval == MAPISTORE_SUCCESS &&
+	    ictx->get_uri(ictx, STRESS_INDEXING_USERNAME, mem_ctx, fmid, &found_uri, &soft_deleted) == MAPISTORE_SUCCESS) {
+		stress_violation(w, "FMID 0x%"PRIx64" still found after deletion", fmid);
+	}
+}
+
+static void indexing_stress_tdb_teardown(TALLOC_CTX *mem_ctx, struct stress_shared *shared)
+{
+	char	*path;
+
+	if (!shared->dir[0]) return;
+
+	path = talloc_asprintf(mem_ctx, "%s/%s/indexing.tdb", shared->dir, STRESS_INDEXING_USERNAME);
+	unlink(path);
+	path = talloc_asprintf(mem_ctx, "%s/%s", shared->dir, STRESS_INDEXING_USERNAME);
+	rmdir(path);
+	rmdir(shared->dir);
+}
+
+static void indexing_stress_mysql_teardown(TALLOC_CTX *mem_ctx, struct stress_shared *shared)
+{
+	stress_mysql_drop(STRESS_INDEXING_MYSQL_DB);
+}
+
+static const struct stress_case stress_cases[] = {
+	{ "openchangedb/mysql",
+	  { "get_new_changeNumber", "get_SystemFolderID", "create_folder", "get_mapistoreURI", "get_fid", "delete_folder" },
+	  "change numbers",
+	  openchangedb_stress_setup, openchangedb_stress_open, openchangedb_stress_step, openchangedb_stress_teardown },
+	{ "indexing/tdb",
+	  { "allocate_fmid", "add_fmid", "get_uri", "get_fmid", "del_fmid" },
+	  "FMIDs",
+	  indexing_stress_tdb_setup, indexing_stress_tdb_open, indexing_stress_step, indexing_stress_tdb_teardown },
+	{ "indexing/mysql",
+	  { "allocate_fmid", "add_fmid", "get_uri", "get_fmid", "del_fmid" },
+	  "FMIDs",
+	  indexing_stress_mysql_setup, indexing_stress_mysql_open, indexing_stress_step, indexing_stress_mysql_teardown }
+};
+
+#define	STRESS_CASES	(sizeof (stress_cases) / sizeof (stress_cases[0]))
+
+/* processes */
+
+/**
+   Run a setup or a teardown in a child, and return its exit status
+ */
+static int stress_run_child(const struct stress_case *sc, struct stress_shared *shared, bool setup)
+{
+	TALLOC_CTX	*mem_ctx;
+	pid_t		pid;
+	int		status;
+	bool		ok = true;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid == -1) return EXIT_FAILURE;
+	if (pid == 0) {
+		mem_ctx = talloc_named(NULL, 0, "stress_run_child");
+		if (setup) {
+			ok = sc->setup(mem_ctx, shared);
+		} else {
+			sc->teardown(mem_ctx, shared);
+		}
+		_exit(ok ? EXIT_SUCCESS : STRESS_SETUP_SKIPPED);
+	}
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status)) return EXIT_FAILURE;
+
+	return WEXITSTATUS(status);
+}
+
+static void stress_worker_main(const struct stress_case *sc, struct stress_shared *shared, uint32_t worker,
+			       int start_fd, uint64_t duration_ns)
+{
+	TALLOC_CTX			*mem_ctx;
+	TALLOC_CTX			*step_ctx;
+	struct stress_worker_ctx	w;
+	uint64_t			end;
+	char				c;
+
+	memset(&w, 0, sizeof (w));
+	w.shared = shared;
+	w.stats = &shared->workers[worker];
+	w.worker = worker;
+
+	mem_ctx = talloc_named(NULL, 0, "stress_worker_main");
+	if (!sc->open(mem_ctx, &w)) {
+		fprintf(stderr, "[ERROR] worker %u: unable to open %s\n", worker, sc->name);
+		_exit(EXIT_FAILURE);
+	}
+
+	/* Wait for every worker to be ready, the parent closes the
+	   pipe to start them all at once */
+	while (read(start_fd, &c, 1) > 0);
+	close(start_fd);
+
+	end = stress_now() + duration_ns;
+	while (stress_now() < end) {
+		step_ctx = talloc_new(mem_ctx);
+		sc->step(step_ctx, &w);
+		talloc_free(step_ctx);
+	}
+
+	talloc_free(mem_ctx);
+	_exit(EXIT_SUCCESS);
+}
+
+/**
+   Wait for the workers, killing the ones still running after the
+   grace delay, and return the number of workers which failed
+ */
+static uint32_t stress_wait_workers(pid_t *pids, uint32_t workers, uint32_t duration)
+{
+	uint64_t	deadline;
+	uint32_t	running = workers;
+	uint32_t	failed = 0;
+	uint32_t	i;
+	int		status;
+	pid_t		pid;
+
+	deadline = stress_now() + (uint64_t) (duration + STRESS_GRACE) * 1000000000ULL;
+	while (running) {
+		pid = waitpid(-1, &status, WNOHANG);
+		if (pid > 0) {
+			for (i = 0; i < workers; i++) {
+				if (pids[i] != pid) continue;
+				pids[i] = 0;
+				running--;
+				if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+					fprintf(stderr, "[ERROR] worker %u failed\n", i);
+					failed++;
+				}
+			}
+			continue;
+		}
+		if (stress_now() > deadline) {
+			for (i = 0; i < workers; i++) {
+				if (!pids[i]) continue;
+				fprintf(stderr, "[ERROR] worker %u stalled, killed\n", i);
+				kill(pids[i], SIGKILL);
+				waitpid(pids[i], &status, 0);
+				pids[i] = 0;
+				failed++;
+			}
+			break;
+		}
+		usleep(100000);
+	}
+
+	return failed;
+}
+
+static int stress_compare_ids(const void *a, const void *b)
+{
+	uint64_t	x = *(const uint64_t *) a;
+	uint64_t	y = *(const uint64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+static uint64_t stress_duplicates(TALLOC_CTX *mem_ctx, struct stress_shared *shared, uint32_t workers)
+{
+	uint64_t	*ids;
+	uint64_t	count = 0;
+	uint64_t	duplicates = 0;
+	uint64_t	i;
+	uint32_t	w;
+
+	for (w = 0; w < workers; w++) {
+		count += shared->workers[w].ids_count;
+	}
+	if (!count) return 0;
+
+	ids = talloc_array(mem_ctx, uint64_t, count);
+	if (!ids) return 0;
+
+	count = 0;
+	for (w = 0; w < workers; w++) {
+		memcpy(ids + count, shared->workers[w].ids, shared->workers[w].ids_count * sizeof (uint64_t));
+		count += shared->workers[w].ids_count;
+	}
+
+	qsort(ids, count, sizeof (uint64_t), stress_compare_ids);
+	for (i = 1; i < count; i++) {
+		if (ids[i] == ids[i - 1]) {
+			if (duplicates++ < 5) {
+				fprintf(stderr, "[VIOLATION] 0x%"PRIx64" allocated twice\n", ids[i]);
+			}
+		}
+	}
+	talloc_free(ids);
+
+	return duplicates;
+}
+
+static uint64_t stress_percentile(const struct stress_op_stats *s, double percentile)
+{
+	uint64_t	rank;
+	uint64_t	seen = 0;
+	uint32_t	i;
+
+	rank = s->count * percentile;
+	for (i = 0; i < STRESS_BUCKETS; i++) {
+		seen += s->buckets[i];
+		if (seen > rank) break;
+	}
+
+	return (i < STRESS_BUCKETS) ? stress_bucket_max(i) : s->max_ns;
+}
+
+/**
+   Print the results of every operation, merged across workers, and
+   return the number of errors and violations
+ */
+static uint64_t stress_report(TALLOC_CTX *mem_ctx, const struct stress_case *sc,
+			      struct stress_shared *shared, uint32_t workers, double elapsed)
+{
+	struct stress_op_stats	total;
+	uint64_t		failures = 0;
+	uint64_t		violations = 0;
+	uint64_t		duplicates;
+	uint64_t		recorded = 0;
+	uint32_t		op, w, i;
+
+	printf("%-40s %10s %10s %10s %10s %10s %8s\n", sc->name, "ops", "ops/s",
+	       "p50 us", "p99 us", "max us", "errors");
+
+	for (op = 0; op < STRESS_MAX_OPS && sc->ops[op]; op++) {
+		memset(&total, 0, sizeof (total));
+		for (w = 0; w < workers; w++) {
+			const struct stress_op_stats	*s = &shared->workers[w].ops[op];
+
+			total.count += s->count;
+			total.errors += s->errors;
+			if (s->max_ns > total.max_ns) total.max_ns = s->max_ns;
+			for (i = 0; i < STRESS_BUCKETS; i++) {
+				total.buckets[i] += s->buckets[i];
+			}
+		}
+		failures += total.errors;
+
+		printf("  %-38s %10"PRIu64" %10.0f %10.1f %10.1f %10.1f %8"PRIu64"\n", sc->ops[op],
+		       total.count, total.count / elapsed,
+		       stress_percentile(&total, 0.50) / 1e3, stress_percentile(&total, 0.99) / 1e3,
+		       total.max_ns / 1e3, total.errors);
+	}
+
+	for (w = 0; w < workers; w++) {
+		violations += shared->workers[w].violations;
+		recorded += shared->workers[w].ids_count;
+	}
+	duplicates = stress_duplicates(mem_ctx, shared, workers);
+
+	printf("  %-38s %10"PRIu64"\n", "lookup violations", violations);
+	printf("  %-38s %10"PRIu64" (of %"PRIu64")\n",
+	       talloc_asprintf(mem_ctx, "duplicate %s", sc->ids), duplicates, recorded);
+
+	return failures + violations + duplicates;
+}
+
+/**
+   Run one stress benchmark and return false if it failed
+ */
+static bool stress_run_case(const struct stress_case *sc, uint32_t workers, uint32_t duration)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct stress_shared	*shared;
+	size_t			size;
+	pid_t			pids[STRESS_MAX_WORKERS];
+	int			start_pipe[2];
+	uint64_t		start;
+	uint64_t		problems;
+	uint32_t		failed;
+	uint32_t		i;
+	int			ret;
+	bool			ok = true;
+
+	size = offsetof(struct stress_shared, workers) + workers * sizeof (struct stress_worker);
+	shared = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (shared == MAP_FAILED) {
+		fprintf(stderr, "[ERROR] Unable to map %zu bytes: %s\n", size, strerror(errno));
+		return false;
+	}
+
+	/* Leftovers of an interrupted run */
+	stress_run_child(sc, shared, false);
+	ret = stress_run_child(sc, shared, true);
+	if (ret != EXIT_SUCCESS) {
+		printf("%-40s %10s\n", sc->name, ret == STRESS_SETUP_SKIPPED ? "skipped" : "failed");
+		stress_run_child(sc, shared, false);
+		munmap(shared, size);
+		return (ret == STRESS_SETUP_SKIPPED);
+	}
+
+	if (pipe(start_pipe) == -1) {
+		stress_run_child(sc, shared, false);
+		munmap(shared, size);
+		return false;
+	}
+
+	fflush(stdout);
+	for (i = 0; i < workers; i++) {
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			close(start_pipe[1]);
+			stress_worker_main(sc, shared, i, start_pipe[0], (uint64_t) duration * 1000000000ULL);
+		}
+		if (pids[i] == -1) {
+			fprintf(stderr, "[ERROR] Unable to fork worker %u: %s\n", i, strerror(errno));
+			workers = i;
+			ok = false;
+			break;
+		}
+	}
+
+	/* Workers open their backend while the pipe is open */
+	close(start_pipe[0]);
+	sleep(1);
+	start = stress_now();
+	close(start_pipe[1]);
+
+	failed = stress_wait_workers(pids, workers, duration);
+
+	mem_ctx = talloc_named(NULL, 0, "stress_run_case");
+	problems = stress_report(mem_ctx, sc, shared, workers, (stress_now() - start) / 1e9);
+	talloc_free(mem_ctx);
+
+	stress_run_child(sc, shared, false);
+	munmap(shared, size);
+
+	return ok && !failed && !problems;
+}
+
+int main(int argc, const char *argv[])
+{
+	poptContext			pc;
+	int				opt;
+	const char			*opt_filter = NULL;
+	uint32_t			workers = STRESS_WORKERS;
+	uint32_t			duration = STRESS_DURATION;
+	uint32_t			i;
+	bool				ok = true;
+
+	enum { OPT_FILTER=1000, OPT_WORKERS, OPT_DURATION, OPT_LIST };
+
+	struct poptOption long_options[] = {
+		POPT_AUTOHELP
+		{ "filter",   0, POPT_ARG_STRING, NULL, OPT_FILTER,   "only stress the backends matching PATTERN", "PATTERN" },
+		{ "workers",  0, POPT_ARG_STRING, NULL, OPT_WORKERS,  "number of worker processes (default: 8)", "N" },
+		{ "duration", 0, POPT_ARG_STRING, NULL, OPT_DURATION, "seconds each backend is stressed (default: 10)", "SECONDS" },
+		{ "list",     0, POPT_ARG_NONE,   NULL, OPT_LIST,     "list the backends", NULL },
+		{ NULL, 0, 0, NULL, 0, NULL, NULL }
+	};
+
+	pc = poptGetContext("openchange-stress", argc, argv, long_options, 0);
+	while ((opt = poptGetNextOpt(pc)) != -1) {
+		switch (opt) {
+		case OPT_FILTER:
+			opt_filter = poptGetOptArg(pc);
+			break;
+		case OPT_WORKERS:
+			workers = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_DURATION:
+			duration = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_LIST:
+			for (i = 0; i < STRESS_CASES; i++) {
+				printf("%s\n", stress_cases[i].name);
+			}
+			poptFreeContext(pc);
+			return EXIT_SUCCESS;
+		default:
+			poptPrintUsage(pc, stderr, 0);
+			return EXIT_FAILURE;
+		}
+	}
+	poptFreeContext(pc);
+
+	if (!workers || workers > STRESS_MAX_WORKERS || !duration) {
+		fprintf(stderr, "[ERROR] workers must be between 1 and %d and duration greater than 0\n",
+			STRESS_MAX_WORKERS);
+		return EXIT_FAILURE;
+	}
+
+	printf("# openchange-stress: %u workers, %u seconds\n", workers, duration);
+	for (i = 0; i < STRESS_CASES; i++) {
+		if (opt_filter && fnmatch(opt_filter, stress_cases[i].name, 0)) continue;
+		if (!stress_run_case(&stress_cases[i], workers, duration)) ok = false;
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
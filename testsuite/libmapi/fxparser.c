@@ -0,0 +1,299 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include "libmapi/fxics.h"
+
+#define	FXPARSER_BINARY_SIZE	10000
+#define	FXPARSER_NAMED_LID	0x8233
+
+/* Callbacks fired while parsing a stream */
+struct fxparser_log {
+	struct fx_parser_context	*parser;
+	char				*text;
+};
+
+/* Global test variables */
+static TALLOC_CTX	*mem_ctx;
+static DATA_BLOB	stream;
+
+static void push_uint32(uint32_t val)
+{
+	uint8_t	buf[4];
+
+	buf[0] = val & 0xFF;
+	buf[1] = (val >> 8) & 0xFF;
+	buf[2] = (val >> 16) & 0xFF;
+	buf[3] = (val >> 24) & 0xFF;
+	data_blob_append(mem_ctx, &stream, buf, 4);
+}
+
+static void push_counted(const void *data, uint32_t length)
+{
+	push_uint32(length);
+	data_blob_append(mem_ctx, &stream, data, length);
+}
+
+/* Build a folder stream with a value of every counted type, a named
+   property and a binary much larger than the buffers it is fed in */
+static void build_stream(void)
+{
+	const uint8_t	subject[] = { 'S', 0, 'u', 0, 'b', 0, 'j', 0, 0, 0 };
+	const uint8_t	guid[16] = { 0x20, 0x86, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+				     0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 };
+	uint8_t		*binary;
+	uint32_t	i;
+
+	stream = data_blob_talloc_named(mem_ctx, NULL, 0, "fxparser stream");
+	binary = talloc_array(mem_ctx, uint8_t, FXPARSER_BINARY_SIZE);
+	for (i = 0; i < FXPARSER_BINARY_SIZE; i++) {
+		binary[i] = i * 7;
+	}
+
+	push_uint32(StartTopFld);
+	push_uint32(PidTagMessageSize);
+	push_uint32(0x1234);
+	push_uint32(PidTagSubject);
+	push_counted(subject, sizeof (subject));
+	push_uint32((PidTagMessageClass & 0xFFFF0000) | PT_STRING8);
+	push_counted("IPM.Note", 8);
+	push_uint32(PidTagRtfCompressed);
+	push_counted(binary, FXPARSER_BINARY_SIZE);
+	push_uint32(0x80010003);
+	data_blob_append(mem_ctx, &stream, guid, sizeof (guid));
+	data_blob_append(mem_ctx, &stream, "", 1);
+	push_uint32(FXPARSER_NAMED_LID);
+	push_uint32(42);
+	push_uint32(MetaTagFXDelProp);
+	push_uint32(PidTagSubject);
+	push_uint32(EndFolder);
+}
+
+/* Build an incremental synchronization stream with a message change,
+   a deletion and the final state */
+static void build_ics_stream(void)
+{
+	const uint8_t	idset[] = { 0x01, 0x00, 0x04, 0x00, 0x00, 0x00, 0x52, 0x01, 0x00, 0x00 };
+
+	stream = data_blob_talloc_named(mem_ctx, NULL, 0, "fxparser ics stream");
+
+	push_uint32(IncrSyncChg);
+	push_uint32(PidTagMid);
+	push_uint32(0x00010001);
+	push_uint32(0x00000000);
+	push_uint32(IncrSyncMessage);
+	push_uint32(PidTagMessageSize);
+	push_uint32(512);
+	push_uint32(IncrSyncDel);
+	push_uint32(MetaTagIdsetDeleted);
+	push_counted(idset, sizeof (idset));
+	push_uint32(IncrSyncStateBegin);
+	push_uint32(MetaTagCnsetSeen);
+	push_counted(idset, sizeof (idset));
+	push_uint32(MetaTagIdsetGiven);
+	push_counted(idset, sizeof (idset));
+	push_uint32(IncrSyncStateEnd);
+	push_uint32(IncrSyncEnd);
+}
+
+static enum MAPISTATUS log_marker(uint32_t marker, void *priv)
+{
+	struct fxparser_log	*log = (struct fxparser_log *) priv;
+
+	log->text = talloc_asprintf_append(log->text, "marker 0x%08x\n", marker);
+	return MAPI_E_SUCCESS;
+}
+
+static enum MAPISTATUS log_delprop(uint32_t proptag, void *priv)
+{
+	struct fxparser_log	*log = (struct fxparser_log *) priv;
+
+	log->text = talloc_asprintf_append(log->text, "delprop 0x%08x\n", proptag);
+	return MAPI_E_SUCCESS;
+}
+
+static enum MAPISTATUS log_namedprop(uint32_t proptag, struct MAPINAMEID nameid, void *priv)
+{
+	struct fxparser_log	*log = (struct fxparser_log *) priv;
+
+	log->text = talloc_asprintf_append(log->text, "namedprop 0x%08x 0x%x\n", proptag, nameid.kind.lid);
+	return MAPI_E_SUCCESS;
+}
+
+static enum MAPISTATUS log_property(struct SPropValue prop, void *priv)
+{
+	struct fxparser_log	*log = (struct fxparser_log *) priv;
+	const char		*str;
+	DATA_BLOB		raw;
+	uint32_t		sum = 0;
+	uint32_t		i;
+
+	switch (prop.ulPropTag & 0xFFFF) {
+	case PT_LONG:
+		ck_assert_int_eq(fxparser_get_raw_value(log->parser, &raw), MAPI_E_NOT_FOUND);
+		log->text = talloc_asprintf_append(log->text, "property 0x%08x %u\n", prop.ulPropTag, prop.value.l);
+		break;
+	case PT_STRING8:
+		log->text = talloc_asprintf_append(log->text, "property 0x%08x %s\n", prop.ulPropTag, prop.value.lpszA);
+		break;
+	case PT_UNICODE:
+		str = prop.value.lpszW;
+		if (!str) {
+			str = fxparser_get_unicode_value(log->parser, mem_ctx);
+		}
+		log->text = talloc_asprintf_append(log->text, "property 0x%08x %s\n", prop.ulPropTag, str);
+		break;
+	case PT_BINARY:
+		ck_assert_int_eq(fxparser_get_raw_value(log->parser, &raw), MAPI_E_SUCCESS);
+		ck_assert_int_eq(raw.length, prop.value.bin.cb);
+		ck_assert(memcmp(raw.data, prop.value.bin.lpb, raw.length) == 0);
+		for (i = 0; i < prop.value.bin.cb; i++) {
+			sum = sum * 31 + prop.value.bin.lpb[i];
+		}
+		log->text = talloc_asprintf_append(log->text, "property 0x%08x %u bytes 0x%08x\n",
+						   prop.ulPropTag, prop.value.bin.cb, sum);
+		break;
+	default:
+		log->text = talloc_asprintf_append(log->text, "property 0x%08x\n", prop.ulPropTag);
+		break;
+	}
+	return MAPI_E_SUCCESS;
+}
+
+/* Parse the stream fed in buffers of chunk bytes and return the
+   callbacks it fired */
+static char *parse_stream(size_t chunk, bool zero_copy)
+{
+	struct fxparser_log	log;
+	DATA_BLOB		buf;
+	size_t			offset;
+
+	log.text = talloc_strdup(mem_ctx, "");
+	log.parser = fxparser_init(mem_ctx, &log);
+	fxparser_set_marker_callback(log.parser, log_marker);
+	fxparser_set_delprop_callback(log.parser, log_delprop);
+	fxparser_set_namedprop_callback(log.parser, log_namedprop);
+	fxparser_set_property_callback(log.parser, log_property);
+	fxparser_set_zero_copy(log.parser, zero_copy);
+
+	for (offset = 0; offset < stream.length; offset += chunk) {
+		buf.data = stream.data + offset;
+		buf.length = MIN(chunk, stream.length - offset);
+		ck_assert_int_eq(fxparser_parse(log.parser, &buf), MAPI_E_SUCCESS);
+	}
+	talloc_free(log.parser);
+
+	return log.text;
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_fxparser_whole) {
+	char	*log;
+
+	log = parse_stream(stream.length, false);
+	ck_assert_str_eq(log,
+			 "marker 0x40090003\n"
+			 "property 0x0e080003 4660\n"
+			 "property 0x0037001f Subj\n"
+			 "property 0x001a001e IPM.Note\n"
+			 "property 0x10090102 10000 bytes 0x920a03b8\n"
+			 "namedprop 0x80010003 0x8233\n"
+			 "property 0x80010003 42\n"
+			 "delprop 0x0037001f\n"
+			 "marker 0x400b0003\n");
+} END_TEST
+
+START_TEST (test_fxparser_chunks) {
+	const size_t	chunks[] = { 1, 2, 3, 7, 100, 4096, 9999 };
+	char		*expected;
+	uint32_t	i;
+
+	expected = parse_stream(stream.length, false);
+	for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++) {
+		ck_assert_str_eq(parse_stream(chunks[i], false), expected);
+	}
+} END_TEST
+
+START_TEST (test_fxparser_zero_copy) {
+	const size_t	chunks[] = { 1, 7, 4096 };
+	char		*expected;
+	uint32_t	i;
+
+	expected = parse_stream(stream.length, false);
+	ck_assert_str_eq(parse_stream(stream.length, true), expected);
+	for (i = 0; i < sizeof (chunks) / sizeof (chunks[0]); i++) {
+		ck_assert_str_eq(parse_stream(chunks[i], true), expected);
+	}
+} END_TEST
+
+START_TEST (test_fxparser_ics) {
+	const char	*expected =
+		"marker 0x40120003\n"
+		"property 0x674a0014\n"
+		"marker 0x40150003\n"
+		"property 0x0e080003 512\n"
+		"marker 0x40130003\n"
+		"property 0x67e50102 10 bytes 0x93f36eca\n"
+		"marker 0x403a0003\n"
+		"property 0x67960102 10 bytes 0x93f36eca\n"
+		"property 0x40170102 10 bytes 0x93f36eca\n"
+		"marker 0x403b0003\n"
+		"marker 0x40140003\n";
+
+	build_ics_stream();
+	ck_assert_str_eq(parse_stream(stream.length, false), expected);
+	ck_assert_str_eq(parse_stream(1, false), expected);
+	ck_assert_str_eq(parse_stream(3, true), expected);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_fxparser_setup(void)
+{
+	mem_ctx = talloc_new(talloc_autofree_context());
+	build_stream();
+}
+
+static void tc_fxparser_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *libmapi_fxparser_suite(void)
+{
+	Suite *s = suite_create("libmapi fxparser");
+	TCase *tc;
+
+	tc = tcase_create("fxparser_parse");
+	tcase_add_checked_fixture(tc, tc_fxparser_setup, tc_fxparser_teardown);
+	tcase_add_test(tc, test_fxparser_whole);
+	tcase_add_test(tc, test_fxparser_chunks);
+	tcase_add_test(tc, test_fxparser_zero_copy);
+	tcase_add_test(tc, test_fxparser_ics);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,345 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+#include <time.h>
+
+/* From MS-OXRTFCP, Section 4.1.1 */
+#define RTF_UNCOMPRESSED1	"{\\rtf1\\ansi\\ansicpg1252\\pard hello world}\r\n"
+
+static const uint8_t rtf_compressed1[] = {
+	0x2d, 0x00, 0x00, 0x00, 0x2b, 0x00, 0x00, 0x00, 0x4c, 0x5a, 0x46, 0x75,
+	0xf1, 0xc5, 0xc7, 0xa7, 0x03, 0x00, 0x0a, 0x00, 0x72, 0x63, 0x70, 0x67,
+	0x31, 0x32, 0x35, 0x42, 0x32, 0x0a, 0xf3, 0x20, 0x68, 0x65, 0x6c, 0x09,
+	0x00, 0x20, 0x62, 0x77, 0x05, 0xb0, 0x6c, 0x64, 0x7d, 0x0a, 0x80, 0x0f,
+	0xa0
+};
+
+/* Global test variables */
+static TALLOC_CTX *mem_ctx;
+
+/* Fill a buffer the way a message body converted to RTF looks like */
+static void fill_body(char *data, size_t size)
+{
+	const char	*words[] = { "\\par ", "Hello ", "the ", "meeting ", "\\b ", "\\b0 ",
+				     "is ", "moved ", "to ", "Thursday", ".\r\n", "{\\f1 " , "}" };
+	size_t		offset = 0;
+	const char	*s;
+
+	srandom(42);
+	while (offset < size) {
+		for (s = words[random() % 13]; *s && offset < size; s++) {
+			data[offset++] = *s;
+		}
+	}
+}
+
+/* The byte at a time decoder uncompress_rtf replaced, used as the
+   reference for valid streams */
+static size_t reference_uncompress(const uint8_t *comp, size_t comp_size, uint8_t *out, size_t out_size)
+{
+	uint8_t		dict[4096];
+	uint32_t	dict_pos = 207;
+	size_t		in_pos = 16;
+	size_t		out_pos = 0;
+	uint32_t	offset;
+	uint32_t	length;
+	uint32_t	i;
+	uint8_t		control;
+	int		bit;
+
+	memset(dict, 0, sizeof (dict));
+	memcpy(dict, "{\\rtf1\\ansi\\mac\\deff0\\deftab720{\\fonttbl;}{\\f0\\fnil \\froman "
+	       "\\fswiss \\fmodern \\fscript \\fdecor MS Sans SerifSymbolArialTimes New "
+	       "RomanCourier{\\colortbl\\red0\\green0\\blue0\r\n\\par \\pard\\plain\\f0"
+	       "\\fs20\\b\\i\\u\\tab\\tx", 207);
+
+	while (in_pos + 1 < comp_size) {
+		control = comp[in_pos++];
+		for (bit = 0; bit < 8 && in_pos < comp_size; bit++) {
+			if (control & (1 << bit)) {
+				offset = (comp[in_pos] << 4) | (comp[in_pos + 1] >> 4);
+				length = (comp[in_pos + 1] & 0x0F) + 2;
+				in_pos += 2;
+				if (offset == dict_pos) {
+					return out_pos;
+				}
+				for (i = 0; i < length && out_pos < out_size; i++) {
+					out[out_pos] = dict[(offset + i) & 0xFFF];
+					dict[dict_pos] = out[out_pos++];
+					dict_pos = (dict_pos + 1) & 0xFFF;
+				}
+			} else if (out_pos < out_size) {
+				out[out_pos] = comp[in_pos++];
+				dict[dict_pos] = out[out_pos++];
+				dict_pos = (dict_pos + 1) & 0xFFF;
+			}
+		}
+	}
+	return out_pos;
+}
+
+/* Bit at a time CRC32 as described in MS-OXRTFCP */
+static uint32_t reference_crc(const uint8_t *data, uint32_t size)
+{
+	uint32_t	crc = 0;
+	uint32_t	i;
+	int		bit;
+
+	for (i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return crc;
+}
+
+static void check_uncompress(const char *rtf, size_t rtf_size)
+{
+	uint8_t		*comp;
+	size_t		comp_size;
+	uint8_t		*ref;
+	size_t		ref_size;
+	DATA_BLOB	uncomp;
+
+	ck_assert_int_eq(compress_rtf(mem_ctx, rtf, rtf_size, &comp, &comp_size), MAPI_E_SUCCESS);
+	ref = talloc_array(mem_ctx, uint8_t, rtf_size + 1);
+	ref_size = reference_uncompress(comp, comp_size, ref, rtf_size);
+	ck_assert_int_eq(ref_size, rtf_size);
+
+	ck_assert_int_eq(uncompress_rtf(mem_ctx, comp, comp_size, &uncomp), MAPI_E_SUCCESS);
+	ck_assert(uncomp.length >= ref_size);
+	ck_assert(memcmp(uncomp.data, ref, ref_size) == 0);
+	ck_assert_int_eq(calculateCRC(comp, 16, comp_size - 16), reference_crc(comp + 16, comp_size - 16));
+
+	talloc_free(uncomp.data);
+	talloc_free(ref);
+	talloc_free(comp);
+}
+
+static void check_roundtrip(const char *rtf, size_t rtf_size)
+{
+	uint8_t		*comp;
+	size_t		comp_size;
+	DATA_BLOB	uncomp;
+
+	ck_assert_int_eq(compress_rtf(mem_ctx, rtf, rtf_size, &comp, &comp_size), MAPI_E_SUCCESS);
+	ck_assert_int_eq(uncompress_rtf(mem_ctx, comp, comp_size, &uncomp), MAPI_E_SUCCESS);
+	ck_assert(uncomp.length >= rtf_size);
+	ck_assert(memcmp(uncomp.data, rtf, rtf_size) == 0);
+	talloc_free(uncomp.data);
+	talloc_free(comp);
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_compress_rtf_reference) {
+	uint8_t		*comp;
+	size_t		comp_size;
+
+	ck_assert_int_eq(compress_rtf(mem_ctx, RTF_UNCOMPRESSED1, sizeof(RTF_UNCOMPRESSED1) - 1,
+				      &comp, &comp_size), MAPI_E_SUCCESS);
+	ck_assert_int_eq(comp_size, sizeof(rtf_compressed1));
+	ck_assert(memcmp(comp, rtf_compressed1, comp_size) == 0);
+} END_TEST
+
+START_TEST (test_compress_rtf_roundtrip) {
+	const size_t	sizes[] = { 0, 1, 2, 17, 18, 4096, 4300, 0x10000 };
+	char		*data;
+	uint32_t	i;
+
+	data = talloc_array(mem_ctx, char, 0x10000);
+
+	/* Matches overlapping the dictionary write position */
+	memset(data, 'a', 0x10000);
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		check_roundtrip(data, sizes[i]);
+	}
+
+	/* Matches across the dictionary wrap around */
+	fill_body(data, 0x10000);
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		check_roundtrip(data, sizes[i]);
+	}
+
+	/* Bytes with the high bit set */
+	srandom(42);
+	for (i = 0; i < 0x10000; i++) {
+		data[i] = 0x80 | (random() % 4);
+	}
+	check_roundtrip(data, 0x10000);
+} END_TEST
+
+START_TEST (test_uncompress_rtf_reference) {
+	const size_t	sizes[] = { 0, 1, 7, 17, 136, 4096, 4300, 0x10000 };
+	char		*data;
+	uint32_t	i;
+
+	data = talloc_array(mem_ctx, char, 0x10000);
+
+	/* Runs copied from a few bytes behind */
+	for (i = 0; i < 0x10000; i++) {
+		data[i] = "abc"[(i / 40) % 3];
+	}
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		check_uncompress(data, sizes[i]);
+	}
+
+	fill_body(data, 0x10000);
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		check_uncompress(data, sizes[i]);
+	}
+} END_TEST
+
+START_TEST (test_calculate_crc) {
+	uint8_t		data[64];
+	uint32_t	offset;
+	uint32_t	length;
+
+	/* MS-OXRTFCP, Section 4.1.1 */
+	ck_assert_int_eq(calculateCRC((uint8_t *)rtf_compressed1, 16, sizeof (rtf_compressed1) - 16),
+			 0xa7c7c5f1);
+
+	/* Every alignment and tail of the slicing by eight loop */
+	srandom(42);
+	for (offset = 0; offset < sizeof (data); offset++) {
+		data[offset] = random();
+	}
+	for (offset = 0; offset < 8; offset++) {
+		for (length = 0; offset + length <= sizeof (data); length++) {
+			ck_assert_int_eq(calculateCRC(data, offset, length),
+					 reference_crc(data + offset, length));
+		}
+	}
+} END_TEST
+
+START_TEST (test_uncompress_rtf_benchmark) {
+	const size_t		size = 102400;
+	const uint32_t		iterations = 100;
+	struct timespec		start, end;
+	char			*data;
+	uint8_t			*comp;
+	size_t			comp_size;
+	DATA_BLOB		uncomp;
+	uint32_t		i;
+	double			elapsed;
+
+	data = talloc_array(mem_ctx, char, size);
+	fill_body(data, size);
+	ck_assert_int_eq(compress_rtf(mem_ctx, data, size, &comp, &comp_size), MAPI_E_SUCCESS);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		ck_assert_int_eq(uncompress_rtf(mem_ctx, comp, comp_size, &uncomp), MAPI_E_SUCCESS);
+		talloc_free(uncomp.data);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "LZFu: %zu bytes decompressed in %.1f us, %.1f MB/s\n",
+		size, elapsed * 1e6 / iterations, size * iterations / elapsed / 1e6);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		calculateCRC((uint8_t *)data, 0, size);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "LZFu: CRC of %zu bytes in %.1f us, %.1f MB/s\n",
+		size, elapsed * 1e6 / iterations, size * iterations / elapsed / 1e6);
+
+	talloc_free(comp);
+	talloc_free(data);
+} END_TEST
+
+START_TEST (test_compress_rtf_benchmark) {
+	const size_t		sizes[] = { 1024, 16384, 262144 };
+	const uint32_t		iterations = 20;
+	struct timespec		start, end;
+	char			*data;
+	uint8_t			*comp;
+	size_t			comp_size;
+	uint32_t		i, j;
+	double			elapsed;
+
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		data = talloc_array(mem_ctx, char, sizes[i]);
+		fill_body(data, sizes[i]);
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (j = 0; j < iterations; j++) {
+			ck_assert_int_eq(compress_rtf(mem_ctx, data, sizes[i], &comp, &comp_size), MAPI_E_SUCCESS);
+			talloc_free(comp);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		ck_assert_int_eq(compress_rtf(mem_ctx, data, sizes[i], &comp, &comp_size), MAPI_E_SUCCESS);
+		elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+		fprintf(stderr, "LZFu: %zu bytes to %zu (%.1fx), %.1f us per body, %.1f MB/s\n",
+			sizes[i], comp_size, (double)sizes[i] / comp_size,
+			elapsed * 1e6 / iterations, sizes[i] * iterations / elapsed / 1e6);
+		talloc_free(comp);
+		talloc_free(data);
+	}
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_lzfu_setup(void)
+{
+	mem_ctx = talloc_new(talloc_autofree_context());
+}
+
+static void tc_lzfu_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *libmapi_lzfu_suite(void)
+{
+	Suite *s = suite_create("libmapi lzfu");
+	TCase *tc;
+
+	tc = tcase_create("compress_rtf");
+	tcase_add_checked_fixture(tc, tc_lzfu_setup, tc_lzfu_teardown);
+	tcase_add_test(tc, test_compress_rtf_reference);
+	tcase_add_test(tc, test_compress_rtf_roundtrip);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("uncompress_rtf");
+	tcase_add_checked_fixture(tc, tc_lzfu_setup, tc_lzfu_teardown);
+	tcase_add_test(tc, test_uncompress_rtf_reference);
+	tcase_add_test(tc, test_calculate_crc);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("compress_rtf_benchmark");
+	tcase_add_checked_fixture(tc, tc_lzfu_setup, tc_lzfu_teardown);
+	tcase_add_test(tc, test_compress_rtf_benchmark);
+	tcase_add_test(tc, test_uncompress_rtf_benchmark);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
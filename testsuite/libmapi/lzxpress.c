@@ -0,0 +1,112 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+/* Global test variables */
+static TALLOC_CTX *mem_ctx;
+
+/* Fill a buffer the way a QueryRows response looks like: rows of
+   identifiers, flags and UTF-16 subjects */
+static void fill_rows(uint8_t *data, uint32_t size)
+{
+	const char	*subjects[] = { "Weekly status", "Re: Budget 2015", "Lunch",
+					"Fwd: Meeting notes", "Invitation: Review" };
+	uint32_t	offset = 0;
+	uint32_t	row = 0;
+	const char	*s;
+
+	while (offset + 64 < size) {
+		memset(data + offset, 0, 12);
+		data[offset] = 0x01;
+		memcpy(data + offset + 4, &row, sizeof (row));
+		offset += 12;
+		for (s = subjects[row % 5]; *s; s++) {
+			data[offset++] = *s;
+			data[offset++] = 0;
+		}
+		data[offset++] = 0;
+		data[offset++] = 0;
+		row++;
+	}
+	memset(data + offset, 0, size - offset);
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_lzxpress_compress_blob) {
+	DATA_BLOB		plain;
+	DATA_BLOB		comp;
+	struct ndr_pull		*ndr;
+	struct ndr_pull		*uncomp;
+	uint32_t		i;
+
+	plain.length = 0x8000;
+	plain.data = talloc_array(mem_ctx, uint8_t, plain.length);
+	fill_rows(plain.data, plain.length);
+
+	ck_assert(lzxpress_compress_blob(mem_ctx, &plain, &comp));
+	ck_assert(comp.length < plain.length);
+
+	ndr = ndr_pull_init_blob(&comp, mem_ctx);
+	ck_assert_int_eq(ndr_pull_lzxpress_decompress(ndr, &uncomp, plain.length), NDR_ERR_SUCCESS);
+	ck_assert_int_eq(uncomp->data_size, plain.length);
+	ck_assert(memcmp(uncomp->data, plain.data, plain.length) == 0);
+
+	/* Incompressible data is left alone */
+	srandom(42);
+	for (i = 0; i < plain.length; i++) {
+		plain.data[i] = random();
+	}
+	ck_assert(!lzxpress_compress_blob(mem_ctx, &plain, &comp));
+
+	plain.length = 0;
+	ck_assert(!lzxpress_compress_blob(mem_ctx, &plain, &comp));
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_lzxpress_setup(void)
+{
+	mem_ctx = talloc_new(talloc_autofree_context());
+}
+
+static void tc_lzxpress_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *libmapi_lzxpress_suite(void)
+{
+	Suite *s = suite_create("libmapi lzxpress");
+	TCase *tc;
+
+	tc = tcase_create("lzxpress_compress_blob");
+	tcase_add_checked_fixture(tc, tc_lzxpress_setup, tc_lzxpress_teardown);
+	tcase_add_test(tc, test_lzxpress_compress_blob);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,265 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include "libmapi/fxics.h"
+
+#define	CACHE_REPLID		0x0001
+#define	CACHE_FID		((0x010401000000ULL << 16) | CACHE_REPLID)
+#define	CACHE_SUBFOLDER		((0x020401000000ULL << 16) | CACHE_REPLID)
+#define	CACHE_CHILDFOLDER	((0x030401000000ULL << 16) | CACHE_REPLID)
+#define	CACHE_MID1		((0x180401000000ULL << 16) | CACHE_REPLID)
+#define	CACHE_MID2		((0x190401000000ULL << 16) | CACHE_REPLID)
+
+/* Global test variables */
+static TALLOC_CTX	*mem_ctx;
+static DATA_BLOB	stream;
+static char		*dir;
+static char		*path;
+
+static void push_uint32(uint32_t val)
+{
+	uint8_t	buf[4];
+
+	buf[0] = val & 0xFF;
+	buf[1] = (val >> 8) & 0xFF;
+	buf[2] = (val >> 16) & 0xFF;
+	buf[3] = (val >> 24) & 0xFF;
+	data_blob_append(mem_ctx, &stream, buf, 4);
+}
+
+static void push_uint64(uint64_t val)
+{
+	push_uint32(val & 0xFFFFFFFF);
+	push_uint32(val >> 32);
+}
+
+static void push_counted(const void *data, uint32_t length)
+{
+	push_uint32(length);
+	data_blob_append(mem_ctx, &stream, data, length);
+}
+
+static void push_idset(uint32_t proptag, uint64_t eid)
+{
+	struct rawidset	*rawidset;
+	struct idset	*idset;
+	struct Binary_r	*bin;
+
+	rawidset = RAWIDSET_make(mem_ctx, true, false);
+	RAWIDSET_push_eid(rawidset, eid);
+	idset = RAWIDSET_convert_to_idset(mem_ctx, rawidset);
+	bin = IDSET_serialize(mem_ctx, idset);
+
+	push_uint32(proptag);
+	push_counted(bin->lpb, bin->cb);
+}
+
+static void push_state(const char *cnset)
+{
+	push_uint32(IncrSyncStateBegin);
+	push_uint32(MetaTagCnsetSeen);
+	push_counted(cnset, strlen(cnset));
+	push_uint32(MetaTagIdsetGiven);
+	push_counted(cnset, strlen(cnset));
+	push_uint32(IncrSyncStateEnd);
+	push_uint32(IncrSyncEnd);
+}
+
+static void push_message(uint64_t mid, const uint8_t *subject, uint32_t length)
+{
+	const uint8_t	recipient[] = { 'R', 0, 0, 0 };
+
+	push_uint32(IncrSyncChg);
+	push_uint32(PidTagMid);
+	push_uint64(mid);
+	push_uint32(IncrSyncMessage);
+	push_uint32(PidTagSubject);
+	push_counted(subject, length);
+	push_uint32(PidTagMessageFlags);
+	push_uint32(0);
+	/* recipients are not cached with the message */
+	push_uint32(StartRecip);
+	push_uint32(PidTagDisplayName);
+	push_counted(recipient, sizeof (recipient));
+	push_uint32(EndToRecip);
+}
+
+static void push_folder(uint64_t fid, const uint8_t *parent_key, uint32_t parent_length, uint8_t key)
+{
+	const uint8_t	name[] = { 'F', 0, 0, 0 };
+
+	push_uint32(IncrSyncChg);
+	push_uint32(PidTagParentSourceKey);
+	push_counted(parent_key, parent_length);
+	push_uint32(PidTagSourceKey);
+	push_counted(&key, 1);
+	push_uint32(PidTagFolderId);
+	push_uint64(fid);
+	push_uint32(PidTagDisplayName);
+	push_counted(name, sizeof (name));
+}
+
+/* Feed the stream to a synchronization and store its result */
+static void apply_stream(struct mapi_cache *cache, enum SynchronizationType type)
+{
+	struct mapi_cache_sync		*sync;
+	struct fx_parser_context	*parser;
+
+	sync = mapi_cache_sync_init(mem_ctx, type, &parser);
+	ck_assert(sync != NULL);
+	ck_assert_int_eq(fxparser_parse(parser, &stream), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_cache_apply(cache, sync, CACHE_FID), MAPI_E_SUCCESS);
+	talloc_free(sync);
+}
+
+static uint32_t get_flags(struct SRow *row)
+{
+	struct SPropValue	*lpProp;
+
+	lpProp = get_SPropValue_SRow(row, PR_MESSAGE_FLAGS);
+	ck_assert(lpProp != NULL);
+	return lpProp->value.l;
+}
+
+static void tc_mapi_cache_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "mapi_cache_suite");
+	dir = talloc_strdup(mem_ctx, "/tmp/mapi_cache_XXXXXX");
+	ck_assert(mkdtemp(dir) != NULL);
+	path = talloc_asprintf(mem_ctx, "%s/profile.cache.tdb", dir);
+}
+
+static void tc_mapi_cache_teardown(void)
+{
+	unlink(path);
+	rmdir(dir);
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_mapi_cache_contents) {
+	const uint8_t		subject1[] = { 'O', 0, 'n', 0, 'e', 0, 0, 0 };
+	const uint8_t		subject2[] = { 'T', 0, 'w', 0, 'o', 0, 0, 0 };
+	struct mapi_cache	*cache;
+	struct SRowSet		rowset;
+	struct SRow		row;
+	struct SPropValue	*lpProp;
+
+	ck_assert_int_eq(mapi_cache_open(mem_ctx, NULL, path, NULL, &cache), MAPI_E_SUCCESS);
+
+	/* First synchronization: two new messages */
+	stream = data_blob_talloc_named(mem_ctx, NULL, 0, "mapi_cache stream");
+	push_message(CACHE_MID2, subject2, sizeof (subject2));
+	push_message(CACHE_MID1, subject1, sizeof (subject1));
+	push_state("first");
+	apply_stream(cache, Contents);
+
+	ck_assert_int_eq(mapi_cache_get_contents(cache, mem_ctx, CACHE_FID, &rowset), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rowset.cRows, 2);
+	lpProp = get_SPropValue_SRow(&rowset.aRow[0], PR_MID);
+	ck_assert(lpProp != NULL);
+	ck_assert(lpProp->value.d == CACHE_MID1);
+	ck_assert_str_eq(get_SPropValue_SRow_data(&rowset.aRow[0], PR_SUBJECT_UNICODE), "One");
+	ck_assert(get_SPropValue_SRow(&rowset.aRow[0], PR_DISPLAY_NAME_UNICODE) == NULL);
+	ck_assert_str_eq(get_SPropValue_SRow_data(&rowset.aRow[1], PR_SUBJECT_UNICODE), "Two");
+
+	/* Second synchronization: the first message is deleted, the
+	   second one is read */
+	stream = data_blob_talloc_named(mem_ctx, NULL, 0, "mapi_cache stream");
+	push_uint32(IncrSyncDel);
+	push_idset(MetaTagIdsetDeleted, CACHE_MID1);
+	push_uint32(IncrSyncRead);
+	push_idset(MetaTagIdsetRead, CACHE_MID2);
+	push_state("second");
+	apply_stream(cache, Contents);
+
+	ck_assert_int_eq(mapi_cache_get_contents(cache, mem_ctx, CACHE_FID, &rowset), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rowset.cRows, 1);
+	ck_assert_int_eq(get_flags(&rowset.aRow[0]), MSGFLAG_READ);
+	ck_assert_int_eq(mapi_cache_get_message(cache, mem_ctx, CACHE_FID, CACHE_MID1, &row), MAPI_E_NOT_FOUND);
+
+	/* The cache survives being reopened */
+	talloc_free(cache);
+	ck_assert_int_eq(mapi_cache_open(mem_ctx, NULL, path, NULL, &cache), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_cache_get_message(cache, mem_ctx, CACHE_FID, CACHE_MID2, &row), MAPI_E_SUCCESS);
+	ck_assert_str_eq(get_SPropValue_SRow_data(&row, PR_SUBJECT_UNICODE), "Two");
+	talloc_free(cache);
+} END_TEST
+
+START_TEST (test_mapi_cache_hierarchy) {
+	const uint8_t		key = 'A';
+	struct mapi_cache	*cache;
+	struct SRowSet		rowset;
+	struct SRow		row;
+	struct SPropValue	*lpProp;
+
+	ck_assert_int_eq(mapi_cache_open(mem_ctx, NULL, path, NULL, &cache), MAPI_E_SUCCESS);
+
+	/* The parent of the first folder is the synchronized folder, the
+	   parent of the second one is the first one */
+	stream = data_blob_talloc_named(mem_ctx, NULL, 0, "mapi_cache stream");
+	push_folder(CACHE_SUBFOLDER, (const uint8_t *) "", 0, key);
+	push_folder(CACHE_CHILDFOLDER, &key, 1, 'B');
+	push_state("first");
+	apply_stream(cache, Hierarchy);
+
+	ck_assert_int_eq(mapi_cache_get_hierarchy(cache, mem_ctx, CACHE_FID, &rowset), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rowset.cRows, 1);
+	lpProp = get_SPropValue_SRow(&rowset.aRow[0], PR_FID);
+	ck_assert(lpProp != NULL);
+	ck_assert(lpProp->value.d == CACHE_SUBFOLDER);
+	ck_assert_str_eq(get_SPropValue_SRow_data(&rowset.aRow[0], PR_DISPLAY_NAME_UNICODE), "F");
+
+	ck_assert_int_eq(mapi_cache_get_hierarchy(cache, mem_ctx, CACHE_SUBFOLDER, &rowset), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rowset.cRows, 1);
+	lpProp = get_SPropValue_SRow(&rowset.aRow[0], PR_FID);
+	ck_assert(lpProp != NULL);
+	ck_assert(lpProp->value.d == CACHE_CHILDFOLDER);
+
+	/* Deleted folders are removed */
+	stream = data_blob_talloc_named(mem_ctx, NULL, 0, "mapi_cache stream");
+	push_uint32(IncrSyncDel);
+	push_idset(MetaTagIdsetDeleted, CACHE_CHILDFOLDER);
+	push_state("second");
+	apply_stream(cache, Hierarchy);
+
+	ck_assert_int_eq(mapi_cache_get_hierarchy(cache, mem_ctx, CACHE_SUBFOLDER, &rowset), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rowset.cRows, 0);
+	ck_assert_int_eq(mapi_cache_get_folder(cache, mem_ctx, CACHE_CHILDFOLDER, &row), MAPI_E_NOT_FOUND);
+	ck_assert_int_eq(mapi_cache_get_folder(cache, mem_ctx, CACHE_SUBFOLDER, &row), MAPI_E_SUCCESS);
+	talloc_free(cache);
+} END_TEST
+
+Suite *libmapi_cache_suite(void)
+{
+	Suite	*s = suite_create("libmapi cache");
+	TCase	*tc;
+
+	tc = tcase_create("mapi_cache");
+	tcase_add_checked_fixture(tc, tc_mapi_cache_setup, tc_mapi_cache_teardown);
+	tcase_add_test(tc, test_mapi_cache_contents);
+	tcase_add_test(tc, test_mapi_cache_hierarchy);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
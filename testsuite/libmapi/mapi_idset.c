@@ -24,6 +24,8 @@
 #include "libmapi/libmapi_private.h"
 #include <gen_ndr/ndr_exchange.h>
 
+#include <time.h>
+
 /* Global test variables */
 static TALLOC_CTX *mem_ctx;
 
@@ -44,12 +46,16 @@ START_TEST (test_IDSET_parse) {
 	const uint8_t		 case_2[] =
 		{0x9b, 0xb9, 0xff, 0xb5, 0xf, 0x44, 0x77, 0x4f, 0xb4, 0x88, 0xc5, 0xc6, 0x70,
 		 0x2e, 0xe3, 0xa8, 0x4, 0x0, 0x0, 0x0, 0x0, 0x52, 0x0, 0xa5, 0x1, 0x51, 0x50, 0x0};
-	const uint8_t		 *cases[] = {case_0, case_1, case_2};
+	/* REPLID-based IDSET using a bitmask: 0x10, 0x11, 0x13 and 0x14 */
+	const uint8_t		case_3[] =
+		{0x1, 0x0, 0x5, 0x0, 0x0, 0x0, 0x0, 0x0, 0x42, 0x10, 0x0d, 0x50, 0x0};
+	const uint8_t		 *cases[] = {case_0, case_1, case_2, case_3};
 	const size_t		 cases_size[] = { sizeof(case_0)/sizeof(uint8_t),
 						  sizeof(case_1)/sizeof(uint8_t),
-						  sizeof(case_2)/sizeof(uint8_t) };
-	const bool		 id_based[] = {true, true, false};
-	const uint32_t		 range_count[] = {2, 1, 1};
+						  sizeof(case_2)/sizeof(uint8_t),
+						  sizeof(case_3)/sizeof(uint8_t) };
+	const bool		 id_based[] = {true, true, false, true};
+	const uint32_t		 range_count[] = {2, 1, 1, 2};
 	const size_t		 CASES_NUM = sizeof(cases)/sizeof(uint8_t*);
 
 	for (i = 0; i < CASES_NUM; i++) {
@@ -159,6 +165,7 @@ START_TEST (test_IDSET_remove_rawidset) {
 	/* Case: Remove last element */
 	IDSET_remove_rawidset(idset_in, rawidset_rm_1);
 
+	range = idset_in->ranges;
 	ck_assert_int_eq(idset_in->range_count, 1);
 	ck_assert_int_eq(range->low, ids[1]);
 	ck_assert_int_eq(range->high, ids[ids_size - 2]);
@@ -166,15 +173,115 @@ START_TEST (test_IDSET_remove_rawidset) {
 	/* Case: Remove middle elements (3rd & 4th in the original set) */
 	IDSET_remove_rawidset(idset_in, rawidset_rm_2);
 
+	range = idset_in->ranges;
 	ck_assert_int_eq(idset_in->range_count, 2);
 	ck_assert_int_eq(range->low, ids[1]);
 	ck_assert_int_eq(range->high, ids[2]);
-	range = range->next;
+	range = &idset_in->ranges[1];
 	ck_assert_int_eq(range->low, ids[5]);
 	ck_assert_int_eq(range->high, ids[ids_size - 2]);
 
 } END_TEST
 
+START_TEST (test_IDSET_merge_idsets) {
+	const uint64_t		left_ids[] = {0x010000000000, 0x020000000000, 0x030000000000,
+					      0x080000000000, 0x090000000000,
+					      0x200000000000};
+	const uint64_t		right_ids[] = {0x040000000000, 0x0a0000000000, 0x0b0000000000,
+					       0x100000000000, 0x110000000000, 0x120000000000};
+	int			i;
+	uint16_t		repl_id = 0x0001;
+	struct rawidset		*rawidset_left, *rawidset_right;
+	struct idset		*idset_left, *idset_right, *merged;
+
+	rawidset_left = RAWIDSET_make(mem_ctx, true, false);
+	for (i = 0; i < sizeof(left_ids)/sizeof(uint64_t); i++) {
+		RAWIDSET_push_eid(rawidset_left, (left_ids[i] << 16) | repl_id);
+	}
+	rawidset_right = RAWIDSET_make(mem_ctx, true, false);
+	for (i = 0; i < sizeof(right_ids)/sizeof(uint64_t); i++) {
+		RAWIDSET_push_eid(rawidset_right, (right_ids[i] << 16) | repl_id);
+	}
+
+	idset_left = RAWIDSET_convert_to_idset(mem_ctx, rawidset_left);
+	idset_right = RAWIDSET_convert_to_idset(mem_ctx, rawidset_right);
+	ck_assert_int_eq(idset_left->range_count, 3);
+	ck_assert_int_eq(idset_right->range_count, 3);
+
+	merged = IDSET_merge_idsets(mem_ctx, idset_left, idset_right);
+	ck_assert(merged != NULL);
+	ck_assert(merged->next == NULL);
+
+	/* [01:03] [04] [08:09] [0a:0b] [10:12] [20], adjacent ranges are not coalesced */
+	ck_assert_int_eq(merged->range_count, 6);
+	for (i = 1; i < merged->range_count; i++) {
+		ck_assert(exchange_globcnt(merged->ranges[i].low) > exchange_globcnt(merged->ranges[i-1].high));
+	}
+
+	for (i = 0; i < sizeof(left_ids)/sizeof(uint64_t); i++) {
+		ck_assert(IDSET_includes_eid(merged, (left_ids[i] << 16) | repl_id));
+	}
+	for (i = 0; i < sizeof(right_ids)/sizeof(uint64_t); i++) {
+		ck_assert(IDSET_includes_eid(merged, (right_ids[i] << 16) | repl_id));
+	}
+	ck_assert(!IDSET_includes_eid(merged, (0x050000000000ULL << 16) | repl_id));
+	ck_assert(!IDSET_includes_eid(merged, (0x130000000000ULL << 16) | repl_id));
+	ck_assert(!IDSET_includes_eid(merged, (0x210000000000ULL << 16) | repl_id));
+	ck_assert(!IDSET_includes_eid(merged, (0x010000000000ULL << 16) | 0x0002));
+
+	/* The original idsets are left untouched */
+	ck_assert_int_eq(idset_left->range_count, 3);
+	ck_assert_int_eq(idset_right->range_count, 3);
+
+} END_TEST
+
+START_TEST (test_IDSET_serialize_benchmark) {
+	const uint32_t		id_count = 30000;
+	const uint32_t		iterations = 100;
+	uint16_t		repl_id = 0x0001;
+	struct rawidset		*rawidset;
+	struct idset		*idset, *parsed;
+	struct timespec		start, end;
+	DATA_BLOB		bin;
+	uint8_t			*buffer;
+	uint32_t		i, size, parse_count = 0;
+	double			elapsed;
+
+	/* Every third id is missing, so each range holds two ids */
+	rawidset = RAWIDSET_make(mem_ctx, true, false);
+	for (i = 1; i <= id_count; i++) {
+		if (i % 3) {
+			RAWIDSET_push_eid(rawidset, (exchange_globcnt(i) << 16) | repl_id);
+		}
+	}
+	idset = RAWIDSET_convert_to_idset(mem_ctx, rawidset);
+	ck_assert(idset != NULL);
+	ck_assert_int_eq(idset->range_count, id_count / 3);
+
+	size = IDSET_serialized_size(idset);
+	buffer = talloc_array(mem_ctx, uint8_t, size);
+	ck_assert(buffer != NULL);
+	ck_assert_int_eq(IDSET_serialize_to_buffer(idset, buffer, size - 1), 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++) {
+		ck_assert_int_eq(IDSET_serialize_to_buffer(idset, buffer, size), size);
+		bin.data = buffer;
+		bin.length = size;
+		parsed = IDSET_parse(mem_ctx, bin, true);
+		ck_assert(parsed != NULL);
+		parse_count = parsed->range_count;
+		talloc_free(parsed);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ck_assert_int_eq(parse_count, idset->range_count);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(stderr, "IDSET round trip: %d ranges, %d bytes, %.1f us per serialize+parse\n",
+		idset->range_count, size, elapsed * 1e6 / iterations);
+
+} END_TEST
+
 // ^ unit tests ---------------------------------------------------------------
 
 // v suite definition ---------------------------------------------------------
@@ -209,6 +316,26 @@ static void tc_IDSET_remove_rawidset_teardown(void)
 	talloc_free(mem_ctx);
 }
 
+static void tc_IDSET_merge_idsets_setup(void)
+{
+	mem_ctx = talloc_new(talloc_autofree_context());
+}
+
+static void tc_IDSET_merge_idsets_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+static void tc_IDSET_serialize_benchmark_setup(void)
+{
+	mem_ctx = talloc_new(talloc_autofree_context());
+}
+
+static void tc_IDSET_serialize_benchmark_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
 Suite *libmapi_idset_suite(void)
 {
 	Suite *s = suite_create("libmapi idset");
@@ -229,5 +356,15 @@ Suite *libmapi_idset_suite(void)
 	tcase_add_test(tc, test_IDSET_remove_rawidset);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("IDSET_merge_idsets");
+	tcase_add_checked_fixture(tc, tc_IDSET_merge_idsets_setup, tc_IDSET_merge_idsets_teardown);
+	tcase_add_test(tc, test_IDSET_merge_idsets);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("IDSET_serialize_benchmark");
+	tcase_add_checked_fixture(tc, tc_IDSET_serialize_benchmark_setup, tc_IDSET_serialize_benchmark_teardown);
+	tcase_add_test(tc, test_IDSET_serialize_benchmark);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
@@ -0,0 +1,130 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/mapi_nameid.h"
+#include "libmapi/libmapi_private.h"
+
+static TALLOC_CTX	*mem_ctx;
+
+static void tc_mapi_nameid_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "mapi_nameid_suite");
+}
+
+static void tc_mapi_nameid_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_mapi_nameid_lookup) {
+	struct mapi_nameid	*nameid;
+	uint16_t		propType;
+	uint32_t		proptag;
+
+	ck_assert_int_eq(mapi_nameid_lid_lookup(0x8005, PSETID_Address, &propType), MAPI_E_SUCCESS);
+	ck_assert_int_eq(propType, PT_UNICODE);
+	ck_assert_int_eq(mapi_nameid_lid_lookup_canonical(0x8005, PSETID_Address, &proptag), MAPI_E_SUCCESS);
+	ck_assert_int_eq(proptag, PidLidFileUnder);
+	/* Same lid in another property set */
+	ck_assert_int_eq(mapi_nameid_lid_lookup(0x8005, PSETID_Remote, &propType), MAPI_E_NOT_FOUND);
+
+	ck_assert_int_eq(mapi_nameid_string_lookup_canonical("Keywords", PS_PUBLIC_STRINGS, &proptag), MAPI_E_SUCCESS);
+	ck_assert_int_eq(proptag, PidNameKeywords);
+	ck_assert_int_eq(mapi_nameid_string_lookup("Keywords", PSETID_Address, &propType), MAPI_E_NOT_FOUND);
+
+	ck_assert_int_eq(mapi_nameid_OOM_lookup("FileUnder", PSETID_Address, &propType), MAPI_E_SUCCESS);
+	ck_assert_int_eq(propType, PT_UNICODE);
+
+	ck_assert_int_eq(mapi_nameid_property_lookup(PidLidFileUnder), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_nameid_property_lookup(PidTagSubject), MAPI_E_NOT_FOUND);
+
+	nameid = mapi_nameid_new(mem_ctx);
+	ck_assert(nameid != NULL);
+	ck_assert_int_eq(mapi_nameid_canonical_add(nameid, PidLidFileUnder), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_nameid_string_add(nameid, "Keywords", PS_PUBLIC_STRINGS), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_nameid_lid_add(nameid, 0x8005, PSETID_Remote), MAPI_E_NOT_FOUND);
+	ck_assert_int_eq(nameid->count, 2);
+	ck_assert_int_eq(nameid->nameid[0].ulKind, MNID_ID);
+	ck_assert_int_eq(nameid->nameid[0].kind.lid, 0x8005);
+	ck_assert_int_eq(nameid->nameid[1].ulKind, MNID_STRING);
+	ck_assert_str_eq(nameid->nameid[1].kind.lpwstr.Name, "Keywords");
+
+	ck_assert_str_eq(get_namedid_name(PidLidFileUnder), "PidLidFileUnder");
+	ck_assert_int_eq(get_namedid_value("PidLidFileUnder"), PidLidFileUnder);
+	ck_assert_int_eq(get_namedid_value("PidLidDoesNotExist"), 0);
+	ck_assert_int_eq(get_namedid_type(PidLidFileUnder >> 16), PT_UNICODE);
+} END_TEST
+
+START_TEST (test_mapi_nameid_cache) {
+	struct mapi_session	*session;
+	struct MAPINAMEID	lid_nameid;
+	struct MAPINAMEID	string_nameid;
+	uint16_t		propID;
+
+	session = talloc_zero(mem_ctx, struct mapi_session);
+
+	memset(&lid_nameid, 0, sizeof (lid_nameid));
+	lid_nameid.ulKind = MNID_ID;
+	GUID_from_string(PSETID_Address, &lid_nameid.lpguid);
+	lid_nameid.kind.lid = 0x8005;
+
+	memset(&string_nameid, 0, sizeof (string_nameid));
+	string_nameid.ulKind = MNID_STRING;
+	GUID_from_string(PS_PUBLIC_STRINGS, &string_nameid.lpguid);
+	string_nameid.kind.lpwstr.Name = "Keywords";
+
+	ck_assert(!mapi_nameid_cache_lookup(session, 1, &lid_nameid, &propID));
+
+	mapi_nameid_cache_add(session, 1, &lid_nameid, 0x8101);
+	mapi_nameid_cache_add(session, 1, &string_nameid, 0x8102);
+	mapi_nameid_cache_add(session, 2, &lid_nameid, 0x8201);
+	/* Unresolved names are not cached */
+	mapi_nameid_cache_add(session, 2, &string_nameid, 0);
+
+	ck_assert(mapi_nameid_cache_lookup(session, 1, &lid_nameid, &propID));
+	ck_assert_int_eq(propID, 0x8101);
+	ck_assert(mapi_nameid_cache_lookup(session, 1, &string_nameid, &propID));
+	ck_assert_int_eq(propID, 0x8102);
+	ck_assert(mapi_nameid_cache_lookup(session, 2, &lid_nameid, &propID));
+	ck_assert_int_eq(propID, 0x8201);
+	ck_assert(!mapi_nameid_cache_lookup(session, 2, &string_nameid, &propID));
+
+	mapi_nameid_cache_flush(session, 1);
+	ck_assert(!mapi_nameid_cache_lookup(session, 1, &lid_nameid, &propID));
+	ck_assert(!mapi_nameid_cache_lookup(session, 1, &string_nameid, &propID));
+	ck_assert(mapi_nameid_cache_lookup(session, 2, &lid_nameid, &propID));
+} END_TEST
+
+Suite *libmapi_nameid_suite(void)
+{
+	Suite	*s = suite_create("libmapi nameid");
+	TCase	*tc;
+
+	tc = tcase_create("mapi_nameid");
+	tcase_add_checked_fixture(tc, tc_mapi_nameid_setup, tc_mapi_nameid_teardown);
+	tcase_add_test(tc, test_mapi_nameid_lookup);
+	tcase_add_test(tc, test_mapi_nameid_cache);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,89 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+static TALLOC_CTX	*mem_ctx;
+
+static void tc_mapi_object_bookmark_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "mapi_object_suite");
+}
+
+static void tc_mapi_object_bookmark_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_mapi_object_bookmark) {
+	mapi_object_t		obj_table;
+	struct SBinary_short	bin;
+	struct SBinary_short	found;
+	uint8_t			data[4];
+	uint32_t		positions[100];
+	uint32_t		i;
+
+	memset(&obj_table, 0, sizeof (mapi_object_t));
+	mapi_object_table_init(mem_ctx, &obj_table);
+
+	/* Positions follow BOOKMARK_END */
+	for (i = 0; i < 100; i++) {
+		data[0] = i;
+		data[1] = data[2] = data[3] = 0xFF;
+		bin.cb = sizeof (data);
+		bin.lpb = data;
+		ck_assert_int_eq(mapi_object_bookmark_add(&obj_table, &bin, &positions[i]), MAPI_E_SUCCESS);
+		ck_assert_int_eq(positions[i], i + 4);
+	}
+
+	for (i = 0; i < 100; i++) {
+		ck_assert_int_eq(mapi_object_bookmark_find(&obj_table, positions[i], &found), MAPI_E_SUCCESS);
+		ck_assert_int_eq(found.cb, 4);
+		ck_assert_int_eq(found.lpb[0], i);
+	}
+
+	ck_assert_int_eq(mapi_object_bookmark_find(&obj_table, BOOKMARK_END, &found), MAPI_E_INVALID_BOOKMARK);
+	ck_assert_int_eq(mapi_object_bookmark_find(&obj_table, 104, &found), MAPI_E_INVALID_BOOKMARK);
+
+	/* Removed bookmarks can't be found any more, the others can */
+	ck_assert_int_eq(mapi_object_bookmark_del(&obj_table, positions[50]), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_object_bookmark_del(&obj_table, positions[50]), MAPI_E_INVALID_BOOKMARK);
+	ck_assert_int_eq(mapi_object_bookmark_find(&obj_table, positions[50], &found), MAPI_E_INVALID_BOOKMARK);
+	ck_assert_int_eq(mapi_object_bookmark_find(&obj_table, positions[51], &found), MAPI_E_SUCCESS);
+	ck_assert_int_eq(found.lpb[0], 51);
+	ck_assert_int_eq(mapi_object_bookmark_find(&obj_table, positions[49], &found), MAPI_E_SUCCESS);
+	ck_assert_int_eq(found.lpb[0], 49);
+} END_TEST
+
+Suite *libmapi_object_suite(void)
+{
+	Suite	*s = suite_create("libmapi object");
+	TCase	*tc;
+
+	tc = tcase_create("mapi_object_bookmark");
+	tcase_add_checked_fixture(tc, tc_mapi_object_bookmark_setup, tc_mapi_object_bookmark_teardown);
+	tcase_add_test(tc, test_mapi_object_bookmark);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
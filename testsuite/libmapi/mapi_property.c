@@ -315,6 +315,65 @@ START_TEST (test_get_SizedXidArray) {
 
 } END_TEST
 
+START_TEST (test_SRowSet_index) {
+	struct SRowSet		rowset;
+	struct SRowSet_index	*index;
+	struct SPropTagArray	*columns;
+	struct SPropValue	*props;
+	uint32_t		i;
+
+	columns = set_SPropTagArray(mem_ctx, 3, PR_FID, PR_DISPLAY_NAME_UNICODE, PR_CONTENT_COUNT);
+	ck_assert(columns != NULL);
+
+	/* Three rows laid out as the columns, the second one with an
+	 * error value, then a row with fewer columns */
+	rowset.cRows = 4;
+	rowset.aRow = talloc_zero_array(mem_ctx, struct SRow, 4);
+	for (i = 0; i < 3; i++) {
+		props = talloc_zero_array(rowset.aRow, struct SPropValue, 3);
+		props[0].ulPropTag = PR_FID;
+		props[0].value.d = 0x100 + i;
+		props[1].ulPropTag = PR_DISPLAY_NAME_UNICODE;
+		props[1].value.lpszW = talloc_asprintf(props, "folder %u", i);
+		props[2].ulPropTag = PR_CONTENT_COUNT;
+		props[2].value.l = i;
+		rowset.aRow[i].cValues = 3;
+		rowset.aRow[i].lpProps = props;
+	}
+	rowset.aRow[1].lpProps[1].ulPropTag = (PR_DISPLAY_NAME_UNICODE & 0xFFFF0000) | PT_ERROR;
+	rowset.aRow[1].lpProps[1].value.err = MAPI_E_NOT_FOUND;
+	props = talloc_zero_array(rowset.aRow, struct SPropValue, 1);
+	props[0].ulPropTag = PR_CONTENT_COUNT;
+	props[0].value.l = 42;
+	rowset.aRow[3].cValues = 1;
+	rowset.aRow[3].lpProps = props;
+
+	index = SRowSet_index_init(mem_ctx, &rowset, columns);
+	ck_assert(index != NULL);
+
+	ck_assert(*(const uint64_t *)SRowSet_index_find_data(index, 2, PR_FID) == 0x102);
+	ck_assert_str_eq((const char *)SRowSet_index_find_data(index, 0, PR_DISPLAY_NAME_UNICODE), "folder 0");
+	ck_assert_int_eq(*(const uint32_t *)SRowSet_index_find_data(index, 1, PR_CONTENT_COUNT), 1);
+
+	/* Error values, other property types and unknown tags */
+	ck_assert(SRowSet_index_find_data(index, 1, PR_DISPLAY_NAME_UNICODE) == NULL);
+	ck_assert(SRowSet_index_find_data(index, 0, PR_DISPLAY_NAME) == NULL);
+	ck_assert(SRowSet_index_find_data(index, 0, PR_MID) == NULL);
+	ck_assert(SRowSet_index_find_data(index, 4, PR_FID) == NULL);
+
+	/* Rows not laid out as the columns are scanned */
+	ck_assert_int_eq(*(const uint32_t *)SRowSet_index_find_data(index, 3, PR_CONTENT_COUNT), 42);
+	ck_assert(SRowSet_index_find_data(index, 3, PR_FID) == NULL);
+
+	/* The columns can come from the first row */
+	talloc_free(index);
+	index = SRowSet_index_init(mem_ctx, &rowset, NULL);
+	ck_assert(index != NULL);
+	for (i = 0; i < 3; i++) {
+		ck_assert(SRowSet_index_get_SPropValue(index, i, PR_FID) == &rowset.aRow[i].lpProps[0]);
+	}
+} END_TEST
+
 // ^ unit tests ---------------------------------------------------------------
 
 // v suite definition ---------------------------------------------------------
@@ -392,6 +451,16 @@ static void get_SizedXidArray_teardown(void)
 	talloc_free(mem_ctx);
 }
 
+static void SRowSet_index_setup(void)
+{
+	mem_ctx = talloc_new(talloc_autofree_context());
+}
+
+static void SRowSet_index_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
 Suite *libmapi_property_suite(void)
 {
 	Suite *s = suite_create("libmapi property");
@@ -419,5 +488,10 @@ Suite *libmapi_property_suite(void)
 	tcase_add_test(tc, test_get_SizedXidArray);
 	suite_add_tcase(s, tc);
 
+	tc = tcase_create("SRowSet_index");
+	tcase_add_unchecked_fixture(tc, SRowSet_index_setup, SRowSet_index_teardown);
+	tcase_add_test(tc, test_SRowSet_index);
+	suite_add_tcase(s, tc);
+
 	return s;
 }
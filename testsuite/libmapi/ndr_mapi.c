@@ -0,0 +1,588 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include <gen_ndr/ndr_exchange.h>
+
+#define	PAYLOAD_SIZE	0x4000
+
+/* Global test variables */
+static TALLOC_CTX *mem_ctx;
+static uint8_t *payload;
+
+
+/* Push a mapi2k7 request holding a single WriteStream ROP */
+static DATA_BLOB push_WriteStream_request(bool compressed)
+{
+	struct mapi_request	request;
+	struct EcDoRpc_MAPI_REQ	mapi_req[2];
+	struct RPC_HEADER_EXT	header;
+	struct ndr_push		*ndr;
+	struct ndr_push		*ndr_rgbIn;
+	uint32_t		handle = 0x1;
+	DATA_BLOB		blob;
+	DATA_BLOB		comp;
+
+	memset(mapi_req, 0, sizeof (mapi_req));
+	mapi_req[0].opnum = op_MAPI_WriteStream;
+	mapi_req[0].u.mapi_WriteStream.data = data_blob_const(payload, PAYLOAD_SIZE);
+	request.length = 2 + 3 + 2 + PAYLOAD_SIZE;
+	request.mapi_len = request.length + sizeof (uint32_t);
+	request.mapi_req = mapi_req;
+	request.handles = &handle;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_mapi_request(ndr, NDR_SCALARS|NDR_BUFFERS, &request), NDR_ERR_SUCCESS);
+	blob = ndr_push_blob(ndr);
+
+	header.Version = 0x0000;
+	header.Flags = RHEF_Last;
+	header.SizeActual = blob.length;
+	if (compressed) {
+		ck_assert(lzxpress_compress_blob(mem_ctx, &blob, &comp));
+		blob = comp;
+		header.Flags |= RHEF_Compressed;
+	}
+	header.Size = blob.length;
+
+	ndr_rgbIn = ndr_push_init_ctx(mem_ctx);
+	ndr_set_flags(&ndr_rgbIn->flags, LIBNDR_FLAG_NOALIGN);
+	ndr_push_RPC_HEADER_EXT(ndr_rgbIn, NDR_SCALARS|NDR_BUFFERS, &header);
+	ndr_push_bytes(ndr_rgbIn, blob.data, blob.length);
+
+	return ndr_push_blob(ndr_rgbIn);
+}
+
+/* Append an extended buffer holding a FastTransferSourceGetBuffer
+   reply with payload[offset, offset + size) to rgbOut */
+static void push_GetBuffer_response(struct ndr_push *rgbOut, uint32_t offset, uint16_t size,
+				    enum TransferStatus status, bool compressed, bool last)
+{
+	struct mapi_response	response;
+	struct EcDoRpc_MAPI_REPL	mapi_repl[2];
+	struct FastTransferSourceGetBuffer_repl	*reply;
+	struct RPC_HEADER_EXT	header;
+	struct ndr_push		*ndr;
+	uint32_t		handle = 0x1;
+	DATA_BLOB		blob;
+	DATA_BLOB		comp;
+
+	memset(&response, 0, sizeof (response));
+	memset(mapi_repl, 0, sizeof (mapi_repl));
+	mapi_repl[0].opnum = op_MAPI_FastTransferSourceGetBuffer;
+	reply = &mapi_repl[0].u.mapi_FastTransferSourceGetBuffer;
+	reply->TransferStatus = status;
+	reply->InProgressCount = offset / 0x1000;
+	reply->TotalStepCount = PAYLOAD_SIZE / 0x1000;
+	reply->TransferBufferSize = size;
+	reply->TransferBuffer = data_blob_const(payload + offset, size);
+	response.length = 2 + 6 + 9 + size;
+	response.mapi_len = response.length + sizeof (uint32_t);
+	response.mapi_repl = mapi_repl;
+	response.handles = &handle;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_mapi_response(ndr, NDR_SCALARS|NDR_BUFFERS, &response), NDR_ERR_SUCCESS);
+	blob = ndr_push_blob(ndr);
+
+	header.Version = 0x0000;
+	header.Flags = last ? RHEF_Last : 0;
+	header.SizeActual = blob.length;
+	if (compressed) {
+		ck_assert(lzxpress_compress_blob(mem_ctx, &blob, &comp));
+		blob = comp;
+		header.Flags |= RHEF_Compressed|RHEF_XorMagic;
+		obfuscate_data(blob.data, blob.length, 0xA5);
+	}
+	header.Size = blob.length;
+
+	ndr_push_RPC_HEADER_EXT(rgbOut, NDR_SCALARS|NDR_BUFFERS, &header);
+	ndr_push_bytes(rgbOut, blob.data, blob.length);
+}
+
+/* Push a mapi_request the generic way, one ROP at a time */
+static DATA_BLOB push_generic_request(const struct mapi_request *request)
+{
+	struct ndr_push	*ndr;
+	uint32_t	i;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	ck_assert_int_eq(ndr_push_uint16(ndr, NDR_SCALARS, request->length), NDR_ERR_SUCCESS);
+	for (i = 0; ndr->offset < request->length - 2; i++) {
+		ck_assert_int_eq(ndr_push_EcDoRpc_MAPI_REQ(ndr, NDR_SCALARS, &request->mapi_req[i]), NDR_ERR_SUCCESS);
+	}
+	for (i = 0; i < (request->mapi_len - request->length) / sizeof (uint32_t); i++) {
+		ck_assert_int_eq(ndr_push_uint32(ndr, NDR_SCALARS, request->handles[i]), NDR_ERR_SUCCESS);
+	}
+
+	return ndr_push_blob(ndr);
+}
+
+/* Push a mapi_response the generic way, one ROP at a time */
+static DATA_BLOB push_generic_response(const struct mapi_response *response)
+{
+	struct ndr_push	*ndr;
+	uint32_t	i;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	ck_assert_int_eq(ndr_push_uint16(ndr, NDR_SCALARS, response->length), NDR_ERR_SUCCESS);
+	for (i = 0; ndr->offset < response->length - 2; i++) {
+		ck_assert_int_eq(ndr_push_EcDoRpc_MAPI_REPL(ndr, NDR_SCALARS, &response->mapi_repl[i]), NDR_ERR_SUCCESS);
+	}
+	for (i = 0; i < (response->mapi_len - response->length) / sizeof (uint32_t); i++) {
+		ck_assert_int_eq(ndr_push_uint32(ndr, NDR_SCALARS, response->handles[i]), NDR_ERR_SUCCESS);
+	}
+
+	return ndr_push_blob(ndr);
+}
+
+/* Prefix a pushed request or response with its mapi_len */
+static struct ndr_pull *pull_init_mapi_blob(DATA_BLOB blob)
+{
+	struct ndr_push	*ndr;
+	DATA_BLOB	wire;
+	struct ndr_pull	*pull;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN);
+	ndr_push_uint32(ndr, NDR_SCALARS, blob.length);
+	ndr_push_bytes(ndr, blob.data, blob.length);
+	wire = ndr_push_blob(ndr);
+
+	pull = ndr_pull_init_blob(&wire, mem_ctx);
+	ndr_set_flags(&pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+
+	return pull;
+}
+
+static void ck_assert_blob_eq(DATA_BLOB a, DATA_BLOB b)
+{
+	ck_assert_int_eq(a.length, b.length);
+	ck_assert(memcmp(a.data, b.data, a.length) == 0);
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_pull_WriteStream_view) {
+	DATA_BLOB		rgbIn;
+	struct ndr_pull		*ndr;
+	struct mapi2k7_request	request;
+	struct WriteStream_req	*req;
+
+	rgbIn = push_WriteStream_request(false);
+	ndr = ndr_pull_init_blob(&rgbIn, mem_ctx);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+	ck_assert_int_eq(ndr_pull_mapi2k7_request(ndr, NDR_SCALARS|NDR_BUFFERS, &request), NDR_ERR_SUCCESS);
+	talloc_free(ndr);
+
+	ck_assert_int_eq(request.mapi_request->mapi_req[0].opnum, op_MAPI_WriteStream);
+	req = &request.mapi_request->mapi_req[0].u.mapi_WriteStream;
+	ck_assert_int_eq(req->data.length, PAYLOAD_SIZE);
+	/* The stream data is not copied out of the request buffer */
+	ck_assert(req->data.data > rgbIn.data && req->data.data < rgbIn.data + rgbIn.length);
+	ck_assert(memcmp(req->data.data, payload, PAYLOAD_SIZE) == 0);
+} END_TEST
+
+START_TEST (test_pull_WriteStream_compressed) {
+	DATA_BLOB		rgbIn;
+	struct ndr_pull		*ndr;
+	struct mapi2k7_request	request;
+	struct WriteStream_req	*req;
+
+	rgbIn = push_WriteStream_request(true);
+	ndr = ndr_pull_init_blob(&rgbIn, mem_ctx);
+	ndr_set_flags(&ndr->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+	ck_assert_int_eq(ndr_pull_mapi2k7_request(ndr, NDR_SCALARS|NDR_BUFFERS, &request), NDR_ERR_SUCCESS);
+	/* The decompressed buffer belongs to the request, not the pull */
+	talloc_free(ndr);
+
+	req = &request.mapi_request->mapi_req[0].u.mapi_WriteStream;
+	ck_assert_int_eq(req->data.length, PAYLOAD_SIZE);
+	ck_assert(memcmp(req->data.data, payload, PAYLOAD_SIZE) == 0);
+	talloc_free(request.mapi_request);
+} END_TEST
+
+START_TEST (test_pull_EcDoRpcExt2_view) {
+	struct EcDoRpcExt2	in;
+	struct EcDoRpcExt2	out;
+	struct policy_handle	handle;
+	struct ndr_push		*push;
+	struct ndr_pull		*pull;
+	DATA_BLOB		rgbIn;
+	DATA_BLOB		stub;
+	uint32_t		pulFlags = pulFlags_Chain;
+	uint32_t		pcbOut = 0x40000;
+	uint32_t		pcbAuxOut = 0x1008;
+	uint8_t			rgbAuxIn[] = { 0 };
+
+	rgbIn = push_WriteStream_request(false);
+	ZERO_STRUCT(handle);
+	ZERO_STRUCT(in);
+	in.in.handle = &handle;
+	in.in.pulFlags = &pulFlags;
+	in.in.rgbIn = rgbIn.data;
+	in.in.cbIn = rgbIn.length;
+	in.in.pcbOut = &pcbOut;
+	in.in.rgbAuxIn = rgbAuxIn;
+	in.in.cbAuxIn = 0;
+	in.in.pcbAuxOut = &pcbAuxOut;
+
+	push = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_EcDoRpcExt2(push, NDR_IN, &in), NDR_ERR_SUCCESS);
+	stub = ndr_push_blob(push);
+
+	ZERO_STRUCT(out);
+	pull = ndr_pull_init_blob(&stub, mem_ctx);
+	pull->flags |= LIBNDR_FLAG_REF_ALLOC;
+	ck_assert_int_eq(ndr_pull_EcDoRpcExt2(pull, NDR_IN, &out), NDR_ERR_SUCCESS);
+
+	ck_assert_int_eq(out.in.cbIn, rgbIn.length);
+	ck_assert(out.in.rgbIn > stub.data && out.in.rgbIn < stub.data + stub.length);
+	ck_assert(memcmp(out.in.rgbIn, rgbIn.data, rgbIn.length) == 0);
+	ck_assert_int_eq(*out.in.pulFlags, pulFlags_Chain);
+	ck_assert_int_eq(*out.out.pcbOut, pcbOut);
+	/* rgbOut is left for the server to allocate */
+	ck_assert(out.out.rgbOut == NULL);
+} END_TEST
+
+START_TEST (test_pull_stream_views) {
+	struct mapi_request	request;
+	struct mapi_request	pulled;
+	struct EcDoRpc_MAPI_REQ	mapi_req[3];
+	struct ndr_push		*ndr;
+	struct ndr_pull		*pull;
+	uint32_t		handle = 0x1;
+	DATA_BLOB		blob;
+	DATA_BLOB		data;
+
+	memset(mapi_req, 0, sizeof (mapi_req));
+	mapi_req[0].opnum = op_MAPI_WriteAndCommitStream;
+	mapi_req[0].u.mapi_WriteAndCommitStream.data = data_blob_const(payload, 0x1000);
+	mapi_req[1].opnum = op_MAPI_FastTransferDestPutBuffer;
+	mapi_req[1].u.mapi_FastTransferDestinationPutBuffer.TransferBufferSize = 0x800;
+	mapi_req[1].u.mapi_FastTransferDestinationPutBuffer.TransferBuffer = data_blob_const(payload + 0x1000, 0x800);
+	request.length = 2 + (3 + 2 + 0x1000) + (3 + 2 + 0x800);
+	request.mapi_len = request.length + sizeof (uint32_t);
+	request.mapi_req = mapi_req;
+	request.handles = &handle;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_mapi_request(ndr, NDR_SCALARS|NDR_BUFFERS, &request), NDR_ERR_SUCCESS);
+	blob = ndr_push_blob(ndr);
+	ck_assert_blob_eq(blob, push_generic_request(&request));
+
+	/* Both payloads are views of the request buffer */
+	pull = pull_init_mapi_blob(blob);
+	ck_assert_int_eq(ndr_pull_mapi_request(pull, NDR_SCALARS|NDR_BUFFERS, &pulled), NDR_ERR_SUCCESS);
+	data = pulled.mapi_req[0].u.mapi_WriteAndCommitStream.data;
+	ck_assert_int_eq(data.length, 0x1000);
+	ck_assert(data.data > pull->data && data.data + data.length <= pull->data + pull->data_size);
+	ck_assert(memcmp(data.data, payload, data.length) == 0);
+	data = pulled.mapi_req[1].u.mapi_FastTransferDestinationPutBuffer.TransferBuffer;
+	ck_assert_int_eq(pulled.mapi_req[1].u.mapi_FastTransferDestinationPutBuffer.TransferBufferSize, 0x800);
+	ck_assert_int_eq(data.length, 0x800);
+	ck_assert(data.data > pull->data && data.data + data.length <= pull->data + pull->data_size);
+	ck_assert(memcmp(data.data, payload + 0x1000, data.length) == 0);
+	ck_assert_blob_eq(push_generic_request(&pulled), blob);
+
+	/* A payload running past the end of the buffer is refused */
+	blob.length -= sizeof (uint32_t) + 0x10;
+	pull = pull_init_mapi_blob(blob);
+	ck_assert_int_ne(ndr_pull_mapi_request(pull, NDR_SCALARS|NDR_BUFFERS, &pulled), NDR_ERR_SUCCESS);
+} END_TEST
+
+START_TEST (test_pull_EcDoRpcExt2_response) {
+	struct EcDoRpcExt2	in;
+	struct EcDoRpcExt2	out;
+	struct policy_handle	handle;
+	struct ndr_push		*push;
+	struct ndr_pull		*pull;
+	DATA_BLOB		stub;
+	uint32_t		pulFlags = 0;
+	uint32_t		pcbOut = 0x1000;
+	uint32_t		pcbAuxOut = 0;
+	uint32_t		pulTransTime = 0;
+	uint8_t			rgbAuxOut[] = { 0 };
+
+	ZERO_STRUCT(handle);
+	ZERO_STRUCT(in);
+	in.out.handle = &handle;
+	in.out.pulFlags = &pulFlags;
+	in.out.rgbOut = payload;
+	in.out.pcbOut = &pcbOut;
+	in.out.rgbAuxOut = rgbAuxOut;
+	in.out.pcbAuxOut = &pcbAuxOut;
+	in.out.pulTransTime = &pulTransTime;
+	in.out.result = MAPI_E_SUCCESS;
+
+	push = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_EcDoRpcExt2(push, NDR_OUT, &in), NDR_ERR_SUCCESS);
+	stub = ndr_push_blob(push);
+
+	/* A client pulls the response with nothing allocated */
+	ZERO_STRUCT(out);
+	pull = ndr_pull_init_blob(&stub, mem_ctx);
+	pull->flags |= LIBNDR_FLAG_REF_ALLOC;
+	ck_assert_int_eq(ndr_pull_EcDoRpcExt2(pull, NDR_OUT, &out), NDR_ERR_SUCCESS);
+	ck_assert_int_eq(*out.out.pcbOut, pcbOut);
+	ck_assert(out.out.rgbOut != NULL);
+	ck_assert(memcmp(out.out.rgbOut, payload, pcbOut) == 0);
+	ck_assert_int_eq(*out.out.pcbAuxOut, 0);
+	ck_assert_int_eq(out.out.result, MAPI_E_SUCCESS);
+
+	/* The proxy pulls it into a request pulled by this function,
+	   which left the output arrays unallocated */
+	ZERO_STRUCT(out);
+	out.out.handle = talloc_zero(mem_ctx, struct policy_handle);
+	out.out.pulFlags = talloc_zero(mem_ctx, uint32_t);
+	out.out.pcbOut = talloc_zero(mem_ctx, uint32_t);
+	out.out.pcbAuxOut = talloc_zero(mem_ctx, uint32_t);
+	out.out.pulTransTime = talloc_zero(mem_ctx, uint32_t);
+	pull = ndr_pull_init_blob(&stub, mem_ctx);
+	ck_assert_int_eq(ndr_pull_EcDoRpcExt2(pull, NDR_OUT, &out), NDR_ERR_SUCCESS);
+	ck_assert_int_eq(*out.out.pcbOut, pcbOut);
+	ck_assert(out.out.rgbOut != NULL);
+	ck_assert(memcmp(out.out.rgbOut, payload, pcbOut) == 0);
+} END_TEST
+
+START_TEST (test_pull_ext2_chained_response) {
+	struct ndr_push				*rgbOut;
+	DATA_BLOB				blob;
+	struct mapi_response			*response = NULL;
+	struct FastTransferSourceGetBuffer_repl	*reply;
+
+	rgbOut = ndr_push_init_ctx(mem_ctx);
+	ndr_set_flags(&rgbOut->flags, LIBNDR_FLAG_NOALIGN);
+	push_GetBuffer_response(rgbOut, 0, 0x1000, TransferStatus_Partial, false, false);
+	push_GetBuffer_response(rgbOut, 0x1000, 0x2000, TransferStatus_Partial, true, false);
+	push_GetBuffer_response(rgbOut, 0x3000, PAYLOAD_SIZE - 0x3000, TransferStatus_Done, true, true);
+	blob = ndr_push_blob(rgbOut);
+
+	ck_assert(NT_STATUS_IS_OK(emsmdb_pull_ext2_response(mem_ctx, &blob, &response)));
+	ck_assert(response != NULL);
+
+	/* The chained transfer buffers are appended to the first reply */
+	ck_assert_int_eq(response->mapi_repl[0].opnum, op_MAPI_FastTransferSourceGetBuffer);
+	reply = &response->mapi_repl[0].u.mapi_FastTransferSourceGetBuffer;
+	ck_assert_int_eq(reply->TransferBuffer.length, PAYLOAD_SIZE);
+	ck_assert(memcmp(reply->TransferBuffer.data, payload, PAYLOAD_SIZE) == 0);
+	ck_assert_int_eq(reply->TransferStatus, TransferStatus_Done);
+	ck_assert_int_eq(reply->InProgressCount, 0x3000 / 0x1000);
+} END_TEST
+
+START_TEST (test_fast_request) {
+	struct mapi_request	request;
+	struct mapi_request	pulled;
+	struct EcDoRpc_MAPI_REQ	mapi_req[6];
+	enum MAPITAGS		properties[] = { PidTagDisplayName, PidTagMessageFlags, PidTagMid };
+	struct ndr_push		*ndr;
+	struct ndr_pull		*pull;
+	uint32_t		handle = 0x1;
+	DATA_BLOB		fast;
+	DATA_BLOB		generic;
+
+	memset(mapi_req, 0, sizeof (mapi_req));
+	mapi_req[0].opnum = op_MAPI_GetProps;
+	mapi_req[0].handle_idx = 0x1;
+	mapi_req[0].u.mapi_GetProps.WantUnicode = 0x1;
+	mapi_req[0].u.mapi_GetProps.prop_count = 3;
+	mapi_req[0].u.mapi_GetProps.properties = properties;
+	mapi_req[1].opnum = op_MAPI_QueryRows;
+	mapi_req[1].u.mapi_QueryRows.ForwardRead = TBL_FORWARD_READ;
+	mapi_req[1].u.mapi_QueryRows.RowCount = 0x32;
+	mapi_req[2].opnum = op_MAPI_ReadStream;
+	mapi_req[2].u.mapi_ReadStream.ByteCount = 0xBABE;
+	mapi_req[2].u.mapi_ReadStream.MaximumByteCount.value = 0x10000;
+	mapi_req[3].opnum = op_MAPI_FastTransferSourceGetBuffer;
+	mapi_req[3].u.mapi_FastTransferSourceGetBuffer.BufferSize = 0x1000;
+	mapi_req[4].opnum = op_MAPI_Release;
+	mapi_req[4].handle_idx = 0x2;
+	request.length = 2 + (3 + 6 + 3 * 4) + (3 + 4) + (3 + 6) + (3 + 2) + 3;
+	request.mapi_len = request.length + sizeof (uint32_t);
+	request.mapi_req = mapi_req;
+	request.handles = &handle;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_mapi_request(ndr, NDR_SCALARS|NDR_BUFFERS, &request), NDR_ERR_SUCCESS);
+	fast = ndr_push_blob(ndr);
+	generic = push_generic_request(&request);
+	ck_assert_blob_eq(fast, generic);
+
+	/* What the fast path pulls is pushed back identically */
+	pull = pull_init_mapi_blob(fast);
+	ck_assert_int_eq(ndr_pull_mapi_request(pull, NDR_SCALARS|NDR_BUFFERS, &pulled), NDR_ERR_SUCCESS);
+	ck_assert_int_eq(pulled.mapi_req[5].opnum, 0);
+	ck_assert_int_eq(pulled.mapi_req[0].u.mapi_GetProps.properties[2], PidTagMid);
+	ck_assert_blob_eq(push_generic_request(&pulled), generic);
+} END_TEST
+
+START_TEST (test_fast_response) {
+	struct mapi_response		response;
+	struct mapi_response		pulled;
+	struct EcDoRpc_MAPI_REPL	mapi_repl[7];
+	struct ndr_push			*ndr;
+	struct ndr_pull			*pull;
+	uint32_t			handle = 0x1;
+	DATA_BLOB			fast;
+	DATA_BLOB			generic;
+
+	memset(&response, 0, sizeof (response));
+	memset(mapi_repl, 0, sizeof (mapi_repl));
+	mapi_repl[0].opnum = op_MAPI_ReadStream;
+	mapi_repl[0].u.mapi_ReadStream.data = data_blob_const(payload, 0x100);
+	mapi_repl[1].opnum = op_MAPI_FastTransferSourceGetBuffer;
+	mapi_repl[1].handle_idx = 0x1;
+	mapi_repl[1].u.mapi_FastTransferSourceGetBuffer.TransferStatus = TransferStatus_Partial;
+	mapi_repl[1].u.mapi_FastTransferSourceGetBuffer.TotalStepCount = 0x2;
+	mapi_repl[1].u.mapi_FastTransferSourceGetBuffer.TransferBufferSize = 0x200;
+	mapi_repl[1].u.mapi_FastTransferSourceGetBuffer.TransferBuffer = data_blob_const(payload + 0x100, 0x200);
+	mapi_repl[2].opnum = op_MAPI_QueryRows;
+	mapi_repl[2].u.mapi_QueryRows.Origin = BOOKMARK_END;
+	/* Release replies are not sent, and failed ROPs take the
+	   generic path */
+	mapi_repl[3].opnum = op_MAPI_Release;
+	mapi_repl[4].opnum = op_MAPI_GetProps;
+	mapi_repl[4].error_code = MAPI_E_NOT_FOUND;
+	mapi_repl[5].opnum = op_MAPI_GetProps;
+	mapi_repl[5].u.mapi_GetProps.prop_data = data_blob_const(payload + 0x300, 0x40);
+	response.length = 2 + (6 + 2 + 0x100) + (6 + 9 + 0x200) + (6 + 3) + 6 + (6 + 1 + 0x40);
+	response.mapi_len = response.length + sizeof (uint32_t);
+	response.mapi_repl = mapi_repl;
+	response.handles = &handle;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_mapi_response(ndr, NDR_SCALARS|NDR_BUFFERS, &response), NDR_ERR_SUCCESS);
+	fast = ndr_push_blob(ndr);
+	generic = push_generic_response(&response);
+	ck_assert_blob_eq(fast, generic);
+
+	pull = pull_init_mapi_blob(fast);
+	ck_assert_int_eq(ndr_pull_mapi_response(pull, NDR_SCALARS|NDR_BUFFERS, &pulled), NDR_ERR_SUCCESS);
+	ck_assert_int_eq(pulled.mapi_repl[3].error_code, MAPI_E_NOT_FOUND);
+	ck_assert_int_eq(pulled.mapi_repl[5].opnum, 0);
+	ck_assert_int_eq(pulled.mapi_repl[4].u.mapi_GetProps.prop_data.length, 0x40);
+	ck_assert_blob_eq(push_generic_response(&pulled), generic);
+} END_TEST
+
+START_TEST (test_backoff_response) {
+	const uint8_t			expected[] = {
+		0x4e, 0x00, 0x80, 0x04, 0x00, 0x00, 0xe8, 0x03, 0x00, 0x00,
+		0xf9, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x4e, 0xe8, 0x03, 0x00, 0x00, 0x00, 0x00
+	};
+	struct mapi_response		response;
+	struct mapi_response		pulled;
+	struct EcDoRpc_MAPI_REPL	mapi_repl[3];
+	struct BackoffRop		rop;
+	struct ndr_push			*ndr;
+	struct ndr_pull			*pull;
+	uint32_t			handle = 0x1;
+	DATA_BLOB			blob;
+
+	/* A busy FastTransferSourceGetBuffer carries its BackoffTime, the
+	   Backoff reply has neither handle index nor return value */
+	memset(&response, 0, sizeof (response));
+	memset(mapi_repl, 0, sizeof (mapi_repl));
+	mapi_repl[0].opnum = op_MAPI_FastTransferSourceGetBuffer;
+	mapi_repl[0].error_code = ecServerBusy;
+	mapi_repl[0].us.mapi_FastTransferSourceGetBuffer.BackoffTime = 1000;
+	rop.RopIdBackoff = op_MAPI_FastTransferSourceGetBuffer;
+	rop.Duration = 1000;
+	mapi_repl[1].opnum = op_MAPI_Backoff;
+	mapi_repl[1].u.mapi_Backoff.BackoffRopCount = 1;
+	mapi_repl[1].u.mapi_Backoff.BackoffRopData = &rop;
+	response.length = 2 + sizeof (expected);
+	response.mapi_len = response.length + sizeof (uint32_t);
+	response.mapi_repl = mapi_repl;
+	response.handles = &handle;
+
+	ndr = ndr_push_init_ctx(mem_ctx);
+	ck_assert_int_eq(ndr_push_mapi_response(ndr, NDR_SCALARS|NDR_BUFFERS, &response), NDR_ERR_SUCCESS);
+	blob = ndr_push_blob(ndr);
+	ck_assert_int_eq(blob.length, 2 + sizeof (expected) + sizeof (uint32_t));
+	ck_assert(memcmp(blob.data + 2, expected, sizeof (expected)) == 0);
+
+	pull = pull_init_mapi_blob(blob);
+	ck_assert_int_eq(ndr_pull_mapi_response(pull, NDR_SCALARS|NDR_BUFFERS, &pulled), NDR_ERR_SUCCESS);
+	ck_assert_int_eq(pulled.mapi_repl[0].error_code, ecServerBusy);
+	ck_assert_int_eq(pulled.mapi_repl[0].us.mapi_FastTransferSourceGetBuffer.BackoffTime, 1000);
+	ck_assert_int_eq(pulled.mapi_repl[1].opnum, op_MAPI_Backoff);
+	ck_assert_int_eq(pulled.mapi_repl[1].u.mapi_Backoff.BackoffRopCount, 1);
+	ck_assert_int_eq(pulled.mapi_repl[1].u.mapi_Backoff.BackoffRopData[0].RopIdBackoff, op_MAPI_FastTransferSourceGetBuffer);
+	ck_assert_int_eq(pulled.mapi_repl[1].u.mapi_Backoff.BackoffRopData[0].Duration, 1000);
+	ck_assert_int_eq(pulled.mapi_repl[2].opnum, 0);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_ndr_mapi_setup(void)
+{
+	uint32_t	i;
+
+	mem_ctx = talloc_new(talloc_autofree_context());
+	payload = talloc_array(mem_ctx, uint8_t, PAYLOAD_SIZE);
+	for (i = 0; i < PAYLOAD_SIZE; i++) {
+		payload[i] = i % 61;
+	}
+}
+
+static void tc_ndr_mapi_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *libmapi_ndr_mapi_suite(void)
+{
+	Suite *s = suite_create("libmapi ndr_mapi");
+	TCase *tc;
+
+	tc = tcase_create("ROP payload views");
+	tcase_add_checked_fixture(tc, tc_ndr_mapi_setup, tc_ndr_mapi_teardown);
+	tcase_add_test(tc, test_pull_WriteStream_view);
+	tcase_add_test(tc, test_pull_WriteStream_compressed);
+	tcase_add_test(tc, test_pull_EcDoRpcExt2_view);
+	tcase_add_test(tc, test_pull_stream_views);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("EcDoRpcExt2 responses");
+	tcase_add_checked_fixture(tc, tc_ndr_mapi_setup, tc_ndr_mapi_teardown);
+	tcase_add_test(tc, test_pull_ext2_chained_response);
+	tcase_add_test(tc, test_pull_EcDoRpcExt2_response);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("Fast ROP codecs");
+	tcase_add_checked_fixture(tc, tc_ndr_mapi_setup, tc_ndr_mapi_teardown);
+	tcase_add_test(tc, test_fast_request);
+	tcase_add_test(tc, test_fast_response);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("Backoff responses");
+	tcase_add_checked_fixture(tc, tc_ndr_mapi_setup, tc_ndr_mapi_teardown);
+	tcase_add_test(tc, test_backoff_response);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,76 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+
+#define	EMSMDB_FILE	"mapiproxy/servers/default/emsmdb/oxcfold.c"
+#define	MYSQL_FILE	"mapiproxy/util/mysql.c"
+#define	INDEXING_FILE	"mapiproxy/libmapistore/backends/indexing_mysql.c"
+
+static void tc_oc_log_teardown(void)
+{
+	oc_log_set_module_level("emsmdb", -1);
+	oc_log_set_module_level("mysql", -1);
+	oc_log_set_module_level("libmapistore", -1);
+}
+
+START_TEST (test_oc_log_module_level) {
+	struct oc_log_site	emsmdb_site = { -1, -1 };
+	struct oc_log_site	mysql_site = { -1, -1 };
+	struct oc_log_site	indexing_site = { -1, -1 };
+
+	ck_assert(!oc_log_enabled(OC_LOG_DEBUG + 9, EMSMDB_FILE, &emsmdb_site));
+
+	ck_assert(oc_log_set_module_level("emsmdb", 10));
+	ck_assert(oc_log_set_module_level("mysql", 2));
+	ck_assert(oc_log_set_module_level("libmapistore", 0));
+
+	/* Sites are resolved again once modules change */
+	ck_assert(oc_log_enabled(OC_LOG_DEBUG + 9, EMSMDB_FILE, &emsmdb_site));
+	ck_assert(!oc_log_enabled(OC_LOG_DEBUG + 10, EMSMDB_FILE, &emsmdb_site));
+
+	/* File names are modules, but only as whole components */
+	ck_assert(oc_log_enabled(OC_LOG_DEBUG + 1, MYSQL_FILE, &mysql_site));
+	ck_assert(!oc_log_enabled(OC_LOG_DEBUG + 2, MYSQL_FILE, &mysql_site));
+	ck_assert(!oc_log_enabled(OC_LOG_DEBUG, INDEXING_FILE, &indexing_site));
+	ck_assert(oc_log_enabled(OC_LOG_ERROR, INDEXING_FILE, &indexing_site));
+
+	/* Back to the samba debug level */
+	ck_assert(oc_log_set_module_level("emsmdb", -1));
+	ck_assert(!oc_log_enabled(OC_LOG_DEBUG + 9, EMSMDB_FILE, &emsmdb_site));
+
+	ck_assert(!oc_log_set_module_level("", 1));
+	ck_assert(!oc_log_set_module_level(NULL, 1));
+} END_TEST
+
+Suite *libmapi_oc_log_suite(void)
+{
+	Suite	*s = suite_create("libmapi oc_log");
+	TCase	*tc;
+
+	tc = tcase_create("oc_log");
+	tcase_add_checked_fixture(tc, NULL, tc_oc_log_teardown);
+	tcase_add_test(tc, test_oc_log_module_level);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
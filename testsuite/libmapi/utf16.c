@@ -0,0 +1,104 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+
+/* ASCII, two, three and four bytes sequences, shorter and longer than
+   the words converted at once */
+static const char *utf16_strings[] = {
+	"",
+	"a",
+	"Hello, world! This is ASCII",
+	"caf\xc3\xa9 na\xc3\xafve \xe2\x82\xac 12345678",
+	"\xf0\x9f\x98\x80 emoji",
+	"abcdefg\xc3\xa9hijklmnop",
+	NULL
+};
+
+/* Global test variables */
+static TALLOC_CTX	*mem_ctx;
+
+static void tc_utf16_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "utf16_suite");
+}
+
+static void tc_utf16_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_utf16_round_trip) {
+	uint8_t		*utf16;
+	char		*utf8;
+	char		*iconv;
+	size_t		length;
+	size_t		converted;
+	uint32_t	i;
+
+	for (i = 0; utf16_strings[i]; i++) {
+		utf16 = mapi_utf16_push_talloc(mem_ctx, utf16_strings[i], &length);
+		ck_assert(utf16 != NULL);
+		ck_assert_int_eq(length, mapi_utf16_size(utf16_strings[i]));
+		ck_assert_int_eq(mapi_utf8_to_utf16(utf16_strings[i], strlen(utf16_strings[i]), NULL), length - 2);
+
+		/* Same bytes as iconv */
+		ck_assert(convert_string_talloc(mem_ctx, CH_UTF8, CH_UTF16LE, utf16_strings[i],
+						strlen(utf16_strings[i]) + 1, (void **) &iconv, &converted));
+		ck_assert_int_eq(converted, length);
+		ck_assert(memcmp(iconv, utf16, length) == 0);
+
+		utf8 = mapi_utf16_pull_talloc(mem_ctx, utf16, length);
+		ck_assert(utf8 != NULL);
+		ck_assert_str_eq(utf8, utf16_strings[i]);
+		ck_assert_int_eq(mapi_utf16_to_utf8(utf16, length, NULL), strlen(utf16_strings[i]));
+	}
+} END_TEST
+
+START_TEST (test_utf16_invalid) {
+	const uint8_t	lone_surrogate[] = { 0x00, 0xD8, 0x41, 0x00 };
+	const uint8_t	embedded_nul[] = { 'a', 0, 'b', 0, 0, 0, 'c', 0, 'd', 0, 'e', 0, 'f', 0, 'g', 0 };
+	char		buf[sizeof (embedded_nul) * 3];
+
+	ck_assert_int_eq(mapi_utf8_to_utf16("\xc3", 1, NULL), -1);
+	ck_assert_int_eq(mapi_utf8_to_utf16("\xe0\x80\x80", 3, NULL), -1);
+	ck_assert_int_eq(mapi_utf8_to_utf16("\xed\xa0\x80", 3, NULL), -1);
+	ck_assert_int_eq(mapi_utf16_to_utf8(lone_surrogate, sizeof (lone_surrogate), NULL), -1);
+
+	/* The conversion stops at the first NUL character */
+	ck_assert_int_eq(mapi_utf16_to_utf8(embedded_nul, sizeof (embedded_nul), buf), 2);
+	ck_assert_str_eq(mapi_utf16_pull_talloc(mem_ctx, embedded_nul, sizeof (embedded_nul)), "ab");
+} END_TEST
+
+Suite *libmapi_utf16_suite(void)
+{
+	Suite	*s = suite_create("libmapi utf16");
+	TCase	*tc;
+
+	tc = tcase_create("utf16");
+	tcase_add_checked_fixture(tc, tc_utf16_setup, tc_utf16_teardown);
+	tcase_add_test(tc, test_utf16_round_trip);
+	tcase_add_test(tc, test_utf16_invalid);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,147 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include "gen_ndr/ndr_exchange.h"
+
+#define	TEST_SERVER	"test_emsmdb"
+
+static TALLOC_CTX			*mem_ctx;
+static struct dcesrv_call_state		*dce_call;
+static uint64_t				dispatched;
+static bool				server_initialized = false;
+
+static NTSTATUS test_dispatch(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_ctx,
+			       void *r, struct mapiproxy *mapiproxy)
+{
+	dispatched++;
+	return NT_STATUS_OK;
+}
+
+static const struct mapiproxy_module test_server = {
+	.status = MAPIPROXY_CUSTOM,
+	.name = TEST_SERVER,
+	.description = "Dispatch test server",
+	.endpoint = NDR_EXCHANGE_EMSMDB_NAME,
+	.dispatch = test_dispatch,
+};
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_server_byendpoint) {
+	const struct mapiproxy_module	*server;
+
+	server = mapiproxy_server_byendpoint(NDR_EXCHANGE_EMSMDB_NAME);
+	ck_assert(server != NULL);
+	ck_assert_str_eq(server->name, TEST_SERVER);
+	ck_assert(server->dispatch == test_dispatch);
+
+	ck_assert(mapiproxy_server_byendpoint(NDR_EXCHANGE_NSP_NAME) == NULL);
+	ck_assert(mapiproxy_server_byendpoint(NULL) == NULL);
+	ck_assert(!mapiproxy_module_loaded(NDR_EXCHANGE_EMSMDB_NAME));
+} END_TEST
+
+START_TEST (test_server_dispatch) {
+	const struct mapiproxy_module	*server;
+	struct mapiproxy		mapiproxy;
+
+	mapiproxy.norelay = false;
+	mapiproxy.ahead = false;
+
+	/* The module chain reaches the server once per call */
+	dispatched = 0;
+	mapiproxy_module_ndr_pull(dce_call, mem_ctx, NULL);
+	mapiproxy_module_pull(dce_call, mem_ctx, NULL);
+	mapiproxy_module_dispatch(dce_call, mem_ctx, NULL, &mapiproxy);
+	ck_assert(NT_STATUS_IS_OK(mapiproxy_server_dispatch(dce_call, mem_ctx, NULL, &mapiproxy)));
+	mapiproxy_module_push(dce_call, mem_ctx, NULL);
+	ck_assert_int_eq(dispatched, 1);
+	ck_assert(mapiproxy.norelay);
+
+	/* So does the dispatch function resolved at bind time */
+	server = mapiproxy_server_byendpoint(NDR_EXCHANGE_EMSMDB_NAME);
+	ck_assert(server != NULL);
+	ck_assert(NT_STATUS_IS_OK(server->dispatch(dce_call, mem_ctx, NULL, &mapiproxy)));
+	ck_assert_int_eq(dispatched, 2);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_dispatch_setup(void)
+{
+	struct loadparm_context			*lp_ctx;
+	struct dcesrv_context			*dce_ctx;
+	struct dcesrv_connection_context	*context;
+	struct dcesrv_interface			*iface;
+
+	mem_ctx = talloc_new(talloc_autofree_context());
+
+	/* The loaded server list is process wide and references the
+	   dcesrv context, which therefore outlives the fixture */
+	if (!server_initialized) {
+		lp_ctx = loadparm_init(talloc_autofree_context());
+		ck_assert(lpcfg_set_cmdline(lp_ctx, "dcerpc_mapiproxy:server", "false"));
+		ck_assert(lpcfg_set_cmdline(lp_ctx, "dcerpc_mapiproxy:emsmdb_server", TEST_SERVER));
+
+		mapiproxy_server_register(&test_server);
+
+		dce_ctx = talloc_zero(talloc_autofree_context(), struct dcesrv_context);
+		dce_ctx->lp_ctx = lp_ctx;
+		ck_assert(NT_STATUS_IS_OK(mapiproxy_server_init(dce_ctx)));
+		server_initialized = true;
+	}
+
+	iface = talloc_zero(mem_ctx, struct dcesrv_interface);
+	iface->name = NDR_EXCHANGE_EMSMDB_NAME;
+	iface->private_data = &ndr_table_exchange_emsmdb;
+	context = talloc_zero(mem_ctx, struct dcesrv_connection_context);
+	context->iface = iface;
+	dce_call = talloc_zero(mem_ctx, struct dcesrv_call_state);
+	dce_call->context = context;
+}
+
+static void tc_dispatch_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_dispatch_suite(void)
+{
+	Suite *s = suite_create("libmapiproxy dispatch");
+	TCase *tc;
+
+	tc = tcase_create("mapiproxy_server_byendpoint");
+	tcase_add_checked_fixture(tc, tc_dispatch_setup, tc_dispatch_teardown);
+	tcase_add_test(tc, test_server_byendpoint);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("mapiproxy_server_dispatch");
+	tcase_add_checked_fixture(tc, tc_dispatch_setup, tc_dispatch_teardown);
+	tcase_add_test(tc, test_server_dispatch);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,207 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+#define	FANOUT_COUNT	5000
+#define	CHAIN_DEPTH	100000
+
+static TALLOC_CTX			*mem_ctx;
+static struct mapi_handles_context	*handles_ctx;
+static uint32_t				freed_count;
+
+
+static int private_data_destructor(uint32_t *data)
+{
+	freed_count++;
+	return 0;
+}
+
+/* Add a handle under container, with private data talloc'd on its
+ * record so that its release can be counted */
+static uint32_t add_handle(uint32_t container)
+{
+	struct mapi_handles	*rec;
+	uint32_t		*data;
+
+	ck_assert_int_eq(mapi_handles_add(handles_ctx, container, &rec), MAPI_E_SUCCESS);
+	data = talloc_zero(rec, uint32_t);
+	ck_assert(data != NULL);
+	*data = rec->handle;
+	talloc_set_destructor(data, private_data_destructor);
+	ck_assert_int_eq(mapi_handles_set_private_data(rec, data), MAPI_E_SUCCESS);
+
+	return rec->handle;
+}
+
+static bool handle_exists(uint32_t handle)
+{
+	struct mapi_handles	*rec;
+
+	return mapi_handles_search(handles_ctx, handle, &rec) == MAPI_E_SUCCESS;
+}
+
+static uint32_t list_count(void)
+{
+	struct mapi_handles	*el;
+	uint32_t		count = 0;
+
+	for (el = handles_ctx->handles; el; el = el->next) {
+		count++;
+	}
+	return count;
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_delete_subtree) {
+	uint32_t	root, folder, table, message, attachment, other, other_child;
+	uint32_t	handle;
+
+	/* root -> folder -> { table, message -> attachment }, and an
+	   unrelated other -> other_child tree */
+	root = add_handle(0);
+	folder = add_handle(root);
+	table = add_handle(folder);
+	message = add_handle(folder);
+	attachment = add_handle(message);
+	other = add_handle(0);
+	other_child = add_handle(other);
+	ck_assert_int_eq(handles_ctx->count, 7);
+
+	ck_assert_int_eq(mapi_handles_delete(handles_ctx, folder), MAPI_E_SUCCESS);
+
+	/* Exactly the subtree went away */
+	ck_assert(!handle_exists(folder));
+	ck_assert(!handle_exists(table));
+	ck_assert(!handle_exists(message));
+	ck_assert(!handle_exists(attachment));
+	ck_assert(handle_exists(root));
+	ck_assert(handle_exists(other));
+	ck_assert(handle_exists(other_child));
+	ck_assert_int_eq(handles_ctx->count, 3);
+	ck_assert_int_eq(list_count(), 3);
+	ck_assert_int_eq(freed_count, 4);
+
+	/* The parent no longer refers to it */
+	ck_assert(handles_ctx->slots[root]->children == NULL);
+	ck_assert(handles_ctx->slots[other]->children == handles_ctx->slots[other_child]);
+
+	/* Released values are reused, the subtree root which went last
+	   comes first */
+	handle = add_handle(root);
+	ck_assert_int_eq(handle, folder);
+	ck_assert(handles_ctx->slots[root]->children == handles_ctx->slots[handle]);
+	ck_assert_int_eq(handles_ctx->count, 4);
+} END_TEST
+
+START_TEST (test_delete_sibling) {
+	uint32_t	parent, first, middle, last;
+
+	parent = add_handle(0);
+	first = add_handle(parent);
+	middle = add_handle(parent);
+	last = add_handle(parent);
+
+	/* Unlinking from the middle of the children keeps the others */
+	ck_assert_int_eq(mapi_handles_delete(handles_ctx, middle), MAPI_E_SUCCESS);
+	ck_assert(handle_exists(first));
+	ck_assert(handle_exists(last));
+	ck_assert_int_eq(mapi_handles_delete(handles_ctx, parent), MAPI_E_SUCCESS);
+	ck_assert(!handle_exists(first));
+	ck_assert(!handle_exists(last));
+	ck_assert_int_eq(handles_ctx->count, 0);
+	ck_assert(handles_ctx->handles == NULL);
+	ck_assert_int_eq(freed_count, 4);
+
+	ck_assert_int_eq(mapi_handles_delete(handles_ctx, parent), MAPI_E_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_delete_fanout) {
+	uint32_t	root, other, i;
+
+	root = add_handle(0);
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		add_handle(root);
+	}
+	other = add_handle(0);
+	ck_assert_int_eq(handles_ctx->count, FANOUT_COUNT + 2);
+
+	ck_assert_int_eq(mapi_handles_delete(handles_ctx, root), MAPI_E_SUCCESS);
+	ck_assert_int_eq(handles_ctx->count, 1);
+	ck_assert_int_eq(list_count(), 1);
+	ck_assert_int_eq(freed_count, FANOUT_COUNT + 1);
+	ck_assert(handle_exists(other));
+	ck_assert_int_eq(handles_ctx->free_count, FANOUT_COUNT + 1);
+} END_TEST
+
+START_TEST (test_delete_chain) {
+	uint32_t	root, handle, i;
+
+	/* Deep enough to overflow the stack of a recursive walk */
+	root = handle = add_handle(0);
+	for (i = 0; i < CHAIN_DEPTH; i++) {
+		handle = add_handle(handle);
+	}
+
+	ck_assert_int_eq(mapi_handles_delete(handles_ctx, root), MAPI_E_SUCCESS);
+	ck_assert_int_eq(handles_ctx->count, 0);
+	ck_assert(!handle_exists(handle));
+	ck_assert_int_eq(freed_count, CHAIN_DEPTH + 1);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_mapi_handles_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "mapi_handles_suite");
+	ck_assert(mem_ctx != NULL);
+
+	handles_ctx = mapi_handles_init(mem_ctx);
+	ck_assert(handles_ctx != NULL);
+	freed_count = 0;
+}
+
+static void tc_mapi_handles_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_mapi_handles_suite(void)
+{
+	Suite	*s = suite_create("libmapiproxy mapi_handles");
+	TCase	*tc;
+
+	tc = tcase_create("mapi_handles_delete");
+	tcase_add_checked_fixture(tc, tc_mapi_handles_setup, tc_mapi_handles_teardown);
+	tcase_add_test(tc, test_delete_subtree);
+	tcase_add_test(tc, test_delete_sibling);
+	tcase_add_test(tc, test_delete_fanout);
+	tcase_add_test(tc, test_delete_chain);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
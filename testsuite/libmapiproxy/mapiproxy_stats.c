@@ -0,0 +1,191 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <stddef.h>
+
+#include "testsuite.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+static TALLOC_CTX		*mem_ctx;
+static struct loadparm_context	*lp_ctx;
+static char			*dir;
+
+/* The statistics of a process outlive the test: every scenario runs
+ * in a child, which reports through its exit status */
+typedef bool (*stats_scenario)(void);
+
+
+static pid_t run_child(stats_scenario scenario)
+{
+	pid_t	pid;
+	int	status;
+
+	pid = fork();
+	ck_assert(pid != -1);
+	if (pid == 0) {
+		exit(scenario() ? 0 : 1);
+	}
+
+	ck_assert_int_eq(waitpid(pid, &status, 0), pid);
+	ck_assert(WIFEXITED(status));
+	ck_assert_int_eq(WEXITSTATUS(status), 0);
+
+	return pid;
+}
+
+static char *stats_path(pid_t pid)
+{
+	char	*path;
+
+	path = talloc_asprintf(mem_ctx, "%s/mapiproxy-%d.stats", dir, (int) pid);
+	ck_assert(path != NULL);
+	return path;
+}
+
+static void create_file(const char *path)
+{
+	int	fd;
+
+	fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	ck_assert(fd != -1);
+	close(fd);
+}
+
+static bool scenario_exit(void)
+{
+	return true;
+}
+
+static bool scenario_init(void)
+{
+	return mapiproxy_stats_init(lp_ctx);
+}
+
+/* Read a value from the statistics file of the process, as readers do */
+static bool check_value(enum mapiproxy_stats_value value, uint64_t expected)
+{
+	uint64_t	v;
+	ssize_t		len;
+	int		fd;
+
+	fd = open(stats_path(getpid()), O_RDONLY);
+	if (fd == -1) return false;
+	len = pread(fd, &v, sizeof (v), offsetof(struct mapiproxy_stats, values) + value * sizeof (uint64_t));
+	close(fd);
+
+	return (len == sizeof (v) && v == expected);
+}
+
+static bool scenario_gauges(void)
+{
+	if (!mapiproxy_stats_init(lp_ctx)) return false;
+
+	/* Released before the file was mapped */
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, -5);
+	if (!check_value(MAPIPROXY_STATS_HANDLES, 0)) return false;
+
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, 3);
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, -1);
+	if (!check_value(MAPIPROXY_STATS_HANDLES, 2)) return false;
+
+	mapiproxy_stats_add(MAPIPROXY_STATS_HANDLES, -10);
+	if (!check_value(MAPIPROXY_STATS_HANDLES, 0)) return false;
+
+	mapiproxy_stats_add(MAPIPROXY_STATS_NSPI_CALLS, 7);
+	return check_value(MAPIPROXY_STATS_NSPI_CALLS, 7);
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_stats_file_lifetime) {
+	char	*dead_path;
+	char	*live_path;
+	char	*other_path;
+	pid_t	pid;
+
+	/* Files of a process which is gone, of one which is still
+	   running and one which is not a statistics file */
+	dead_path = stats_path(run_child(scenario_exit));
+	create_file(dead_path);
+	live_path = stats_path(getpid());
+	create_file(live_path);
+	other_path = talloc_asprintf(mem_ctx, "%s/mapiproxy-1.stats.old", dir);
+	ck_assert(other_path != NULL);
+	create_file(other_path);
+
+	/* The process maps its file, then removes it when it exits */
+	pid = run_child(scenario_init);
+	ck_assert(access(stats_path(pid), F_OK) == -1);
+
+	ck_assert(access(dead_path, F_OK) == -1);
+	ck_assert(access(live_path, F_OK) == 0);
+	ck_assert(access(other_path, F_OK) == 0);
+
+	unlink(live_path);
+	unlink(other_path);
+} END_TEST
+
+START_TEST (test_stats_gauges) {
+	run_child(scenario_gauges);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tc_stats_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "mapiproxy_stats_suite");
+	ck_assert(mem_ctx != NULL);
+
+	dir = talloc_strdup(mem_ctx, "/tmp/mapiproxy_stats_XXXXXX");
+	ck_assert(dir != NULL);
+	ck_assert(mkdtemp(dir) != NULL);
+
+	lp_ctx = loadparm_init(mem_ctx);
+	ck_assert(lp_ctx != NULL);
+	ck_assert(lpcfg_set_cmdline(lp_ctx, "mapiproxy:runtime_stats", "true"));
+	ck_assert(lpcfg_set_cmdline(lp_ctx, "mapiproxy:runtime_stats_dir", dir));
+}
+
+static void tc_stats_teardown(void)
+{
+	rmdir(dir);
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_stats_suite(void)
+{
+	Suite	*s = suite_create("libmapiproxy stats");
+	TCase	*tc;
+
+	tc = tcase_create("mapiproxy_stats");
+	tcase_add_checked_fixture(tc, tc_stats_setup, tc_stats_teardown);
+	tcase_add_test(tc, test_stats_file_lifetime);
+	tcase_add_test(tc, test_stats_gauges);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -385,6 +385,42 @@ START_TEST (test_get_next_changeNumber) {
 	}
 } END_TEST
 
+START_TEST (test_change_numbers_across_contexts) {
+	struct openchangedb_context	*oc_ctx2 = NULL;
+	struct openchangedb_context	*ctxs[2];
+	struct UI8Array_r		*cns;
+	uint64_t			cn = 0, next_cn = 0, last = 0, value;
+	int				i, j;
+
+	/* A second context stands for another process or session
+	   allocating change numbers for the same mailbox */
+	initialize_mysql(g_mem_ctx, &oc_ctx2);
+	ctxs[0] = g_oc_ctx;
+	ctxs[1] = oc_ctx2;
+
+	for (i = 0; i < 10; i++) {
+		retval = openchangedb_get_next_changeNumber(ctxs[(i + 1) % 2], USER1, &next_cn);
+		CHECK_SUCCESS;
+		retval = openchangedb_get_new_changeNumber(ctxs[i % 2], USER1, &cn);
+		CHECK_SUCCESS;
+		ck_assert(cn == next_cn);
+		value = exchange_globcnt(cn >> 16);
+		ck_assert(value > last);
+		last = value;
+
+		retval = openchangedb_get_new_changeNumbers(ctxs[(i + 1) % 2], g_mem_ctx, USER1, 3, &cns);
+		CHECK_SUCCESS;
+		ck_assert_int_eq(3, cns->cValues);
+		for (j = 0; j < 3; j++) {
+			value = exchange_globcnt(cns->lpui8[j] >> 16);
+			ck_assert(value == last + 1);
+			last = value;
+		}
+	}
+
+	talloc_free(oc_ctx2);
+} END_TEST
+
 START_TEST (test_get_folder_property) {
 	void *data;
 	uint64_t fid;
@@ -428,6 +464,46 @@ START_TEST (test_get_folder_property) {
 	ck_assert_int_eq(46, ((struct Binary_r *)data)->cb);
 } END_TEST
 
+START_TEST (test_get_folder_properties) {
+	struct SPropTagArray	properties;
+	enum MAPITAGS		tags[4];
+	void			*data[4];
+	enum MAPISTATUS		retvals[4];
+	uint64_t		fid;
+
+	properties.cValues = 3;
+	properties.aulPropTag = tags;
+	tags[0] = PidTagDisplayName;
+	tags[1] = PidTagRights;
+	tags[2] = PidTagFolderId;
+	fid = 14124414331340718081ul;
+	retval = openchangedb_get_folder_properties(g_mem_ctx, g_oc_ctx, USER1, &properties, fid, data, retvals);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(retvals[0], MAPI_E_SUCCESS);
+	ck_assert_str_eq("A3", (char *)data[0]);
+	ck_assert_int_eq(retvals[1], MAPI_E_SUCCESS);
+	ck_assert_int_eq(2043, *(int *)data[1]);
+	ck_assert_int_eq(retvals[2], MAPI_E_SUCCESS);
+	ck_assert(fid == *(uint64_t *)data[2]);
+
+	// Mailbox, with a property the record doesn't have
+	properties.cValues = 4;
+	tags[0] = PidTagLastModificationTime;
+	tags[1] = PidTagDisplayName;
+	tags[2] = PidTagDisplayName;
+	tags[3] = PidTagAttributeSystem;
+	fid = 17438782182108692481ul;
+	retval = openchangedb_get_folder_properties(g_mem_ctx, g_oc_ctx, USER1, &properties, fid, data, retvals);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(retvals[0], MAPI_E_SUCCESS);
+	ck_assert_int_eq(130268260180000000 >> 32, ((struct FILETIME *)data[0])->dwHighDateTime);
+	ck_assert_int_eq(retvals[1], MAPI_E_SUCCESS);
+	ck_assert_str_eq("OpenChange Mailbox: paco", (char *)data[1]);
+	ck_assert_int_eq(retvals[2], MAPI_E_SUCCESS);
+	ck_assert_str_eq("OpenChange Mailbox: paco", (char *)data[2]);
+	ck_assert_int_eq(retvals[3], MAPI_E_NOT_FOUND);
+} END_TEST
+
 START_TEST (test_get_public_folder_property) {
 	void *data;
 	uint32_t proptag;
@@ -1174,6 +1250,7 @@ START_TEST (test_build_table_folders_with_restrictions) {
 	CHECK_SUCCESS;
 
 	res.rt = RES_PROPERTY;
+	res.res.resProperty.relop = RELOP_EQ;
 	res.res.resProperty.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.value.lpszW = "Schedule";
@@ -1201,6 +1278,7 @@ START_TEST (test_build_table_folders_live_filtering) {
 	CHECK_SUCCESS;
 
 	res.rt = RES_PROPERTY;
+	res.res.resProperty.relop = RELOP_EQ;
 	res.res.resProperty.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.value.lpszW = "Schedule";
@@ -1225,6 +1303,73 @@ START_TEST (test_build_table_folders_live_filtering) {
 	ck_assert_str_eq("Schedule", (char *)data);
 } END_TEST
 
+START_TEST (test_build_table_folders_with_restrictions_filtered) {
+	void *table, *data;
+	uint64_t fid;
+	struct mapi_SRestriction res;
+
+	fid = 17438782182108692481ul;
+	retval = openchangedb_table_init(g_mem_ctx, g_oc_ctx, USER1, 1, fid, &table);
+	CHECK_SUCCESS;
+
+	/* Content restrictions are not pushed down to SQL */
+	memset(&res, 0, sizeof (res));
+	res.rt = RES_CONTENT;
+	res.res.resContent.fuzzy = FL_PREFIX;
+	res.res.resContent.ulPropTag = PidTagDisplayName;
+	res.res.resContent.lpProp.ulPropTag = PidTagDisplayName;
+	res.res.resContent.lpProp.value.lpszW = "Sched";
+	retval = openchangedb_table_set_restrictions(g_oc_ctx, table, &res);
+	CHECK_SUCCESS;
+
+	retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+						 PidTagDisplayName, 0, false, &data);
+	CHECK_SUCCESS;
+	ck_assert_str_eq("Schedule", (char *)data);
+
+	retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+						 PidTagDisplayName, 1, false, &data);
+	ck_assert_int_eq(retval, MAPI_E_INVALID_OBJECT);
+} END_TEST
+
+START_TEST (test_build_table_folders_across_pages) {
+	void		*table, *data;
+	uint64_t	fid;
+	uint64_t	fids[13];
+	char		*names[13];
+	int		i;
+
+	fid = 17438782182108692481ul;
+	retval = openchangedb_table_init(g_mem_ctx, g_oc_ctx, USER1, 1, fid, &table);
+	CHECK_SUCCESS;
+
+	for (i = 0; i < 13; i++) {
+		retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+							 PidTagFolderId, i, false, &data);
+		CHECK_SUCCESS;
+		fids[i] = *(uint64_t *)data;
+		retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+							 PidTagDisplayName, i, false, &data);
+		CHECK_SUCCESS;
+		names[i] = (char *)data;
+	}
+	retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+						 PidTagFolderId, 13, false, &data);
+	ck_assert_int_eq(retval, MAPI_E_INVALID_OBJECT);
+
+	/* Seeking back loads the same rows again */
+	for (i = 12; i >= 0; i--) {
+		retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+							 PidTagDisplayName, i, false, &data);
+		CHECK_SUCCESS;
+		ck_assert_str_eq(names[i], (char *)data);
+		retval = openchangedb_table_get_property(g_mem_ctx, g_oc_ctx, table,
+							 PidTagFolderId, i, false, &data);
+		CHECK_SUCCESS;
+		ck_assert(fids[i] == *(uint64_t *)data);
+	}
+} END_TEST
+
 START_TEST (test_set_locale) {
 	ck_assert(openchangedb_set_locale(g_oc_ctx, USER1, 0x1001));
 	ck_assert(!openchangedb_set_locale(g_oc_ctx, USER1, 0x1001));
@@ -1281,6 +1426,208 @@ START_TEST (test_get_indexing_url) {
 	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
 } END_TEST
 
+START_TEST (test_recursive_folder_counts) {
+	uint64_t fids[2], fid, pfid;
+	uint32_t count;
+
+	fids[0] = 18231415716525899777ul;
+	fids[1] = 17438782182108692481ul;
+
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[0], &count);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+
+	retval = openchangedb_set_recursive_folder_count(g_oc_ctx, USER1, fids[0], 20);
+	CHECK_SUCCESS;
+	retval = openchangedb_set_recursive_folder_count(g_oc_ctx, USER1, fids[1], 3);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[0], &count);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 20);
+
+	/* Both ancestors move together, never below 0 */
+	retval = openchangedb_update_recursive_folder_counts(g_oc_ctx, USER1, 2, fids, 2);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[0], &count);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 22);
+	retval = openchangedb_update_recursive_folder_counts(g_oc_ctx, USER1, 2, fids, -10);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[0], &count);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 12);
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[1], &count);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 0);
+
+	retval = openchangedb_clear_recursive_folder_counts(g_oc_ctx, USER1, 1, fids);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[0], &count);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[1], &count);
+	CHECK_SUCCESS;
+
+	/* Folders created in openchangedb directly forget every count */
+	pfid = fids[0];
+	fid = 10813142705316560897ul;
+	retval = openchangedb_create_folder(g_oc_ctx, USER1, pfid, fid, 424242, NULL, -1);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_recursive_folder_count(g_oc_ctx, USER1, fids[1], &count);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_get_folder_tree) {
+	struct openchangedb_folder_tree_entry	*entries;
+	struct SPropTagArray			*properties;
+	uint32_t				count;
+
+	properties = set_SPropTagArray(g_mem_ctx, 2, PidTagFolderId, PidTagParentFolderId);
+
+	/* Parent first, the children in creation order */
+	retval = openchangedb_get_folder_tree(g_mem_ctx, g_oc_ctx, USER1, 17438782182108692481ul, 0,
+					      properties, &count, &entries);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 27);
+	ck_assert(entries[0].fid == 18087300528450043905ul);
+	ck_assert_int_eq(entries[0].depth, 0);
+	ck_assert(entries[7].fid == 18231415716525899777ul);
+	ck_assert(!entries[7].mapistore);
+	ck_assert(entries[8].fid == 18303473310563827713ul);
+	ck_assert(entries[8].parent_fid == 18231415716525899777ul);
+	ck_assert_int_eq(entries[8].depth, 1);
+	ck_assert(entries[8].mapistore);
+	ck_assert_int_eq(entries[8].retvals[0], MAPI_E_SUCCESS);
+	ck_assert(*(uint64_t *)entries[8].data[0] == 18303473310563827713ul);
+	ck_assert(*(uint64_t *)entries[8].data[1] == 18231415716525899777ul);
+	ck_assert(entries[26].fid == 18159358122487971841ul);
+	ck_assert_int_eq(entries[26].depth, 0);
+
+	/* Depth-limited */
+	retval = openchangedb_get_folder_tree(g_mem_ctx, g_oc_ctx, USER1, 17438782182108692481ul, 1,
+					      properties, &count, &entries);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 12);
+
+	/* Public folders */
+	retval = openchangedb_get_folder_tree(g_mem_ctx, g_oc_ctx, USER1, 72057594037927937ul, 0,
+					      properties, &count, &entries);
+	CHECK_SUCCESS;
+	ck_assert_int_eq(count, 8);
+	ck_assert(entries[4].fid == 576460752303423489ul);
+	ck_assert_int_eq(entries[4].depth, 2);
+	ck_assert(entries[7].fid == 144115188075855873ul);
+
+	retval = openchangedb_get_folder_tree(g_mem_ctx, g_oc_ctx, USER1, 42, 0, properties, &count, &entries);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_hierarchy_change_numbers) {
+	uint64_t fids[2], fid, pfid, cn;
+
+	fids[0] = 18231415716525899777ul;
+	fids[1] = 17438782182108692481ul;
+
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[0], &cn);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+
+	retval = openchangedb_set_hierarchy_change_numbers(g_oc_ctx, USER1, 2, fids, 0x140001);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[1], &cn);
+	CHECK_SUCCESS;
+	ck_assert(cn == 0x140001);
+
+	/* Change numbers never go back */
+	retval = openchangedb_set_hierarchy_change_numbers(g_oc_ctx, USER1, 1, fids, 0x150001);
+	CHECK_SUCCESS;
+	retval = openchangedb_set_hierarchy_change_numbers(g_oc_ctx, USER1, 2, fids, 0x100001);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[0], &cn);
+	CHECK_SUCCESS;
+	ck_assert(cn == 0x150001);
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[1], &cn);
+	CHECK_SUCCESS;
+	ck_assert(cn == 0x140001);
+
+	retval = openchangedb_clear_hierarchy_change_numbers(g_oc_ctx, USER1, 1, fids);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[0], &cn);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[1], &cn);
+	CHECK_SUCCESS;
+
+	/* Folders created in openchangedb directly forget every change number */
+	pfid = fids[0];
+	fid = 10813142705316560897ul;
+	retval = openchangedb_create_folder(g_oc_ctx, USER1, pfid, fid, 424242, NULL, -1);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_hierarchy_change_number(g_oc_ctx, USER1, fids[1], &cn);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_message_counts) {
+	struct openchangedb_message_counts	counts, delta;
+	uint64_t				fids[2];
+
+	fids[0] = 18231415716525899777ul;
+	fids[1] = 17438782182108692481ul;
+
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[0], 0, &counts);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+
+	/* Folders without counters stay without */
+	delta.messages = 1;
+	delta.fai = 0;
+	delta.unread = 1;
+	delta.size = 1024;
+	retval = openchangedb_update_message_counts(g_oc_ctx, USER1, fids[0], &delta);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[0], 0, &counts);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+
+	counts.messages = 10;
+	counts.fai = 2;
+	counts.unread = 3;
+	counts.size = 5000000000;
+	retval = openchangedb_set_message_counts(g_oc_ctx, USER1, fids[0], &counts);
+	CHECK_SUCCESS;
+	retval = openchangedb_set_message_counts(g_oc_ctx, USER1, fids[1], &counts);
+	CHECK_SUCCESS;
+
+	retval = openchangedb_update_message_counts(g_oc_ctx, USER1, fids[0], &delta);
+	CHECK_SUCCESS;
+	memset(&counts, 0, sizeof(counts));
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[0], 3600, &counts);
+	CHECK_SUCCESS;
+	ck_assert(counts.messages == 11);
+	ck_assert(counts.fai == 2);
+	ck_assert(counts.unread == 4);
+	ck_assert(counts.size == 5000001024);
+
+	/* Never below 0 */
+	delta.messages = 0;
+	delta.fai = -5;
+	delta.unread = -1;
+	delta.size = 0;
+	retval = openchangedb_update_message_counts(g_oc_ctx, USER1, fids[1], &delta);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[1], 0, &counts);
+	CHECK_SUCCESS;
+	ck_assert(counts.messages == 10);
+	ck_assert(counts.fai == 0);
+	ck_assert(counts.unread == 2);
+
+	retval = openchangedb_clear_message_counts(g_oc_ctx, USER1, 1, fids);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[0], 0, &counts);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[1], 0, &counts);
+	CHECK_SUCCESS;
+
+	retval = openchangedb_clear_message_counts(g_oc_ctx, USER1, 0, NULL);
+	CHECK_SUCCESS;
+	retval = openchangedb_get_message_counts(g_oc_ctx, USER1, fids[1], 0, &counts);
+	ck_assert_int_eq(retval, MAPI_E_NOT_FOUND);
+} END_TEST
+
 // ^ Unit test ----------------------------------------------------------------
 
 // v Suite definition ---------------------------------------------------------
@@ -1393,6 +1740,7 @@ static Suite *openchangedb_create_suite(const char *backend_name,
 	tcase_add_test(tc, test_get_new_changeNumbers);
 	tcase_add_test(tc, test_get_next_changeNumber);
 	tcase_add_test(tc, test_get_folder_property);
+	tcase_add_test(tc, test_get_folder_properties);
 	tcase_add_test(tc, test_get_public_folder_property);
 	tcase_add_test(tc, test_set_folder_properties);
 	tcase_add_test(tc, test_set_folder_properties_on_mailbox);
@@ -1429,9 +1777,16 @@ static Suite *openchangedb_create_suite(const char *backend_name,
 
 	if (strcmp(backend_name, "MySQL") == 0) {
 		// Ugly workaround to test mysql only functions
+		tcase_add_test(tc, test_build_table_folders_with_restrictions_filtered);
+		tcase_add_test(tc, test_build_table_folders_across_pages);
 		tcase_add_test(tc, test_set_locale);
 		tcase_add_test(tc, test_get_folders_names);
 		tcase_add_test(tc, test_get_indexing_url);
+		tcase_add_test(tc, test_recursive_folder_counts);
+		tcase_add_test(tc, test_get_folder_tree);
+		tcase_add_test(tc, test_hierarchy_change_numbers);
+		tcase_add_test(tc, test_change_numbers_across_contexts);
+		tcase_add_test(tc, test_message_counts);
 	}
 
 	tcase_add_test(tc, test_set_receive_folder_to_mailbox);
@@ -184,6 +184,33 @@ START_TEST(test_call_get_ReceiveFolder) {
 	ck_assert_int_eq(fid, FOLDER_ID_EXPECTED);
 	ck_assert(!strcmp(ExplicitMessageClass, DFT_MESSAGE_CLASS));
 } END_TEST
+START_TEST (test_profile) {
+	struct openchangedb_logger_stats stats;
+	uint64_t folder_id;
+
+	/* Calls are not accounted until profiling is enabled */
+	CHECK_SUCCESS(openchangedb_get_SystemFolderID(oc_ctx, "recipient", 1234, &folder_id));
+	CHECK_FAILURE(openchangedb_logger_get_stats(oc_ctx, "get_SystemFolderID", NULL, &stats));
+
+	CHECK_SUCCESS(openchangedb_logger_set_profiling(oc_ctx, 0, 10, NULL));
+	CHECK_SUCCESS(openchangedb_get_SystemFolderID(oc_ctx, "recipient", 1234, &folder_id));
+	CHECK_SUCCESS(openchangedb_get_SystemFolderID(oc_ctx, "recipient", 1234, &folder_id));
+	CHECK_SUCCESS(openchangedb_get_PublicFolderID(oc_ctx, "usera", 1234, &folder_id));
+	ck_assert_int_eq(functions_called.get_SystemFolderID, 3);
+
+	CHECK_SUCCESS(openchangedb_logger_get_stats(oc_ctx, "get_SystemFolderID", NULL, &stats));
+	ck_assert(stats.count == 2);
+	ck_assert(stats.max_usec <= stats.total_usec);
+
+	CHECK_SUCCESS(openchangedb_logger_get_stats(oc_ctx, NULL, "recipient", &stats));
+	ck_assert(stats.count == 2);
+	CHECK_SUCCESS(openchangedb_logger_get_stats(oc_ctx, NULL, "usera", &stats));
+	ck_assert(stats.count == 1);
+	CHECK_FAILURE(openchangedb_logger_get_stats(oc_ctx, "get_MailboxGuid", NULL, &stats));
+
+	openchangedb_logger_dump_profile(oc_ctx);
+} END_TEST
+
 // ^ Unit test ----------------------------------------------------------------
 
 
@@ -718,6 +745,7 @@ static Suite *openchangedb_create_suite(SFun setup, SFun teardown)
 	tcase_add_test(tc, test_call_get_fid);
 	tcase_add_test(tc, test_call_get_MAPIStoreURIs);
 	tcase_add_test(tc, test_call_get_ReceiveFolder);
+	tcase_add_test(tc, test_profile);
 
 	suite_add_tcase(s, tc);
 	return s;
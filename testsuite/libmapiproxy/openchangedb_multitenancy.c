@@ -1406,6 +1406,7 @@ START_TEST (test_build_table_folders_with_restrictions) {
 	CHECK_SUCCESS;
 
 	res.rt = RES_PROPERTY;
+	res.res.resProperty.relop = RELOP_EQ;
 	res.res.resProperty.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.value.lpszW = "Schedule";
@@ -1441,6 +1442,7 @@ START_TEST (test_build_table_folders_live_filtering) {
 	CHECK_SUCCESS;
 
 	res.rt = RES_PROPERTY;
+	res.res.resProperty.relop = RELOP_EQ;
 	res.res.resProperty.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.ulPropTag = PidTagDisplayName;
 	res.res.resProperty.lpProp.value.lpszW = "Schedule";
@@ -0,0 +1,234 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+static TALLOC_CTX	*mem_ctx;
+
+/* Row used by every test */
+static uint32_t		row_flags = 0x5;
+static uint64_t		row_mid = 100;
+static const char	*row_subject = "Hello World";
+
+static enum MAPISTATUS get_row_property(void *private_data, enum MAPITAGS proptag, void **data)
+{
+	switch (proptag) {
+	case PidTagMessageFlags:
+		*data = &row_flags;
+		return MAPI_E_SUCCESS;
+	case PidTagMid:
+		*data = &row_mid;
+		return MAPI_E_SUCCESS;
+	case PidTagNormalizedSubject:
+		*data = (void *)row_subject;
+		return MAPI_E_SUCCESS;
+	default:
+		return MAPI_E_NOT_FOUND;
+	}
+}
+
+static void set_property_restriction(struct mapi_SRestriction *res, uint8_t relop, uint64_t mid)
+{
+	memset(res, 0, sizeof (*res));
+	res->rt = RES_PROPERTY;
+	res->res.resProperty.relop = relop;
+	res->res.resProperty.ulPropTag = PidTagMid;
+	res->res.resProperty.lpProp.ulPropTag = PidTagMid;
+	res->res.resProperty.lpProp.value.d = mid;
+}
+
+static bool match(struct mapi_SRestriction *res)
+{
+	struct mapiproxy_restriction	*program;
+	enum MAPISTATUS			retval;
+
+	retval = mapiproxy_restriction_compile(mem_ctx, res, &program);
+	ck_assert_int_eq(retval, MAPI_E_SUCCESS);
+
+	return mapiproxy_restriction_match(program, get_row_property, NULL);
+}
+
+static void tc_restriction_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "restriction_suite");
+}
+
+static void tc_restriction_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_restriction_property) {
+	struct mapi_SRestriction	res;
+
+	set_property_restriction(&res, RELOP_EQ, 100);
+	ck_assert(match(&res));
+	set_property_restriction(&res, RELOP_GT, 50);
+	ck_assert(match(&res));
+	set_property_restriction(&res, RELOP_LT, 50);
+	ck_assert(!match(&res));
+
+	/* Missing properties never match */
+	res.res.resProperty.ulPropTag = PidTagFolderId;
+	res.res.resProperty.relop = RELOP_NE;
+	ck_assert(!match(&res));
+} END_TEST
+
+START_TEST (test_restriction_connectives) {
+	struct mapi_SRestriction	children[3], nested[2];
+	struct mapi_SRestriction	res, inner;
+	struct mapiproxy_restriction	*program;
+
+	set_property_restriction(&children[0], RELOP_EQ, 100);
+	set_property_restriction(&children[1], RELOP_GT, 50);
+	set_property_restriction(&children[2], RELOP_LT, 50);
+
+	inner.rt = RES_AND;
+	inner.res.resAnd.cRes = 2;
+	inner.res.resAnd.res = (struct mapi_SRestriction_and *)children;
+	ck_assert(match(&inner));
+	inner.res.resAnd.cRes = 3;
+	ck_assert(!match(&inner));
+
+	inner.rt = RES_OR;
+	ck_assert(match(&inner));
+
+	/* OR(c, OR(a, b, c)) is flattened into a single OR */
+	nested[0] = children[2];
+	nested[1] = inner;
+	res.rt = RES_OR;
+	res.res.resOr.cRes = 2;
+	res.res.resOr.res = (struct mapi_SRestriction_or *)nested;
+	ck_assert_int_eq(mapiproxy_restriction_compile(mem_ctx, &res, &program), MAPI_E_SUCCESS);
+	ck_assert_int_eq(program->count, 5);
+	ck_assert_int_eq(program->instrs[0].length, 5);
+	ck_assert(mapiproxy_restriction_match(program, get_row_property, NULL));
+
+	/* Empty connectives */
+	res.res.resOr.cRes = 0;
+	ck_assert(!match(&res));
+	res.rt = RES_AND;
+	ck_assert(match(&res));
+
+	res.rt = RES_NOT;
+	memcpy(&res.res.resNot.res, &children[2], sizeof (struct mapi_SRestriction));
+	ck_assert(match(&res));
+} END_TEST
+
+START_TEST (test_restriction_content) {
+	struct mapi_SRestriction	res;
+
+	memset(&res, 0, sizeof (res));
+	res.rt = RES_CONTENT;
+	res.res.resContent.ulPropTag = PidTagNormalizedSubject;
+	res.res.resContent.lpProp.ulPropTag = PidTagNormalizedSubject;
+	res.res.resContent.lpProp.value.lpszW = "WORLD";
+	res.res.resContent.fuzzy = FL_SUBSTRING | FL_IGNORECASE;
+	ck_assert(match(&res));
+	res.res.resContent.fuzzy = FL_SUBSTRING;
+	ck_assert(!match(&res));
+
+	res.res.resContent.lpProp.value.lpszW = "hello";
+	res.res.resContent.fuzzy = FL_PREFIX | FL_IGNORECASE;
+	ck_assert(match(&res));
+	res.res.resContent.fuzzy = FL_FULLSTRING | FL_IGNORECASE;
+	ck_assert(!match(&res));
+	res.res.resContent.lpProp.value.lpszW = "hello world";
+	ck_assert(match(&res));
+} END_TEST
+
+START_TEST (test_restriction_bitmask_exist) {
+	struct mapi_SRestriction	res;
+
+	memset(&res, 0, sizeof (res));
+	res.rt = RES_BITMASK;
+	res.res.resBitmask.relMBR = BMR_NEZ;
+	res.res.resBitmask.ulPropTag = PidTagMessageFlags;
+	res.res.resBitmask.ulMask = 0x4;
+	ck_assert(match(&res));
+	res.res.resBitmask.relMBR = BMR_EQZ;
+	res.res.resBitmask.ulMask = 0x2;
+	ck_assert(match(&res));
+
+	res.rt = RES_EXIST;
+	res.res.resExist.ulPropTag = PidTagNormalizedSubject;
+	ck_assert(match(&res));
+	res.res.resExist.ulPropTag = PidTagFolderId;
+	ck_assert(!match(&res));
+} END_TEST
+
+START_TEST (test_restriction_unsupported) {
+	struct mapi_SRestriction	res;
+	struct mapiproxy_restriction	*program;
+
+	memset(&res, 0, sizeof (res));
+	res.rt = RES_SUBRESTRICTION;
+	ck_assert_int_eq(mapiproxy_restriction_compile(mem_ctx, &res, &program), MAPI_E_TOO_COMPLEX);
+
+	/* A NULL program matches everything */
+	ck_assert(mapiproxy_restriction_match(NULL, get_row_property, NULL));
+} END_TEST
+
+START_TEST (test_restriction_proptags) {
+	struct mapi_SRestriction	children[2];
+	struct mapi_SRestriction	res;
+	struct mapiproxy_restriction	*program;
+	struct SPropTagArray		proptags;
+
+	set_property_restriction(&children[0], RELOP_GT, 50);
+	set_property_restriction(&children[1], RELOP_LT, 200);
+	memset(&res, 0, sizeof (res));
+	res.rt = RES_AND;
+	res.res.resAnd.cRes = 2;
+	res.res.resAnd.res = (struct mapi_SRestriction_and *)children;
+	ck_assert_int_eq(mapiproxy_restriction_compile(mem_ctx, &res, &program), MAPI_E_SUCCESS);
+
+	/* Each property is added once, existing tags are kept */
+	proptags.cValues = 1;
+	proptags.aulPropTag = talloc_array(mem_ctx, enum MAPITAGS, 1);
+	proptags.aulPropTag[0] = PidTagMessageFlags;
+	ck_assert_int_eq(mapiproxy_restriction_add_proptags(mem_ctx, program, &proptags), MAPI_E_SUCCESS);
+	ck_assert_int_eq(proptags.cValues, 2);
+	ck_assert_int_eq(proptags.aulPropTag[1], PidTagMid);
+	ck_assert_int_eq(mapiproxy_restriction_add_proptags(mem_ctx, NULL, &proptags), MAPI_E_SUCCESS);
+	ck_assert_int_eq(proptags.cValues, 2);
+} END_TEST
+
+Suite *mapiproxy_restriction_suite(void)
+{
+	Suite	*s = suite_create("libmapiproxy restriction");
+	TCase	*tc;
+
+	tc = tcase_create("mapiproxy_restriction");
+	tcase_add_checked_fixture(tc, tc_restriction_setup, tc_restriction_teardown);
+	tcase_add_test(tc, test_restriction_property);
+	tcase_add_test(tc, test_restriction_connectives);
+	tcase_add_test(tc, test_restriction_content);
+	tcase_add_test(tc, test_restriction_bitmask_exist);
+	tcase_add_test(tc, test_restriction_unsupported);
+	tcase_add_test(tc, test_restriction_proptags);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,233 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+static TALLOC_CTX	*mem_ctx;
+
+/* Message the rules are evaluated on */
+static uint32_t		message_flags = MSGFLAG_UNMODIFIED;
+
+static enum MAPISTATUS get_message_property(void *private_data, enum MAPITAGS proptag, void **data)
+{
+	switch (proptag) {
+	case PidTagMessageFlags:
+		*data = &message_flags;
+		return MAPI_E_SUCCESS;
+	default:
+		return MAPI_E_NOT_FOUND;
+	}
+}
+
+/* Condition matching messages which flags equal value */
+static void set_flags_restriction(struct mapi_SRestriction *res, uint32_t value)
+{
+	memset(res, 0, sizeof (*res));
+	res->rt = RES_PROPERTY;
+	res->res.resProperty.relop = RELOP_EQ;
+	res->res.resProperty.ulPropTag = PidTagMessageFlags;
+	res->res.resProperty.lpProp.ulPropTag = PidTagMessageFlags;
+	res->res.resProperty.lpProp.value.l = value;
+}
+
+/* Row of a rule marking messages as read, id is only set when not 0 */
+static void set_rule(struct RuleData *rule, uint8_t flags, uint64_t id, uint32_t sequence, uint32_t state,
+		     const struct mapi_SRestriction *res)
+{
+	struct mapi_SPropValue	*props;
+	struct RuleAction	*actions;
+	uint16_t		count = 0;
+
+	props = talloc_zero_array(mem_ctx, struct mapi_SPropValue, 5);
+	actions = talloc_zero(mem_ctx, struct RuleAction);
+	actions->count = 1;
+	actions->ActionBlock = talloc_zero_array(actions, struct ActionBlock, 1);
+	actions->ActionBlock[0].ActionLength = 9;
+	actions->ActionBlock[0].ActionBlockData.ActionType = ActionType_OP_MARK_AS_READ;
+
+	if (id) {
+		props[count].ulPropTag = PidTagRuleId;
+		props[count++].value.d = id;
+	}
+	props[count].ulPropTag = PidTagRuleSequence;
+	props[count++].value.l = sequence;
+	props[count].ulPropTag = PidTagRuleState;
+	props[count++].value.l = state;
+	if (res) {
+		props[count].ulPropTag = PidTagRuleCondition;
+		memcpy(&props[count++].value.Restrictions, res, sizeof (*res));
+	}
+	props[count].ulPropTag = PidTagRuleActions;
+	props[count++].value.RuleAction = *actions;
+
+	rule->RuleDataFlags = flags;
+	rule->PropertyValues.cValues = count;
+	rule->PropertyValues.lpProps = props;
+}
+
+static void tc_rules_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "rules_suite");
+}
+
+static void tc_rules_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_rules_modify) {
+	struct mapiproxy_rules		*rules;
+	struct ModifyRules_req		request;
+	struct RuleData			data[2];
+	struct mapi_SRestriction	res;
+	void				*value;
+
+	ck_assert_int_eq(mapiproxy_rules_unpack(mem_ctx, &data_blob_null, &rules), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rules->count, 0);
+
+	/* Added rules are given an id and sorted by sequence */
+	set_flags_restriction(&res, MSGFLAG_UNMODIFIED);
+	set_rule(&data[0], ROW_ADD, 0, 20, MAPIPROXY_RULE_ENABLED, &res);
+	set_rule(&data[1], ROW_ADD, 0, 10, MAPIPROXY_RULE_ENABLED, &res);
+	request.ModifyRulesFlags = 0;
+	request.RulesCount = 2;
+	request.RulesData = data;
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rules->count, 2);
+	ck_assert_int_eq(rules->rules[0].id, 2);
+	ck_assert_int_eq(rules->rules[0].sequence, 10);
+	ck_assert_int_eq(rules->rules[1].id, 1);
+	ck_assert(rules->rules[0].condition != NULL);
+	ck_assert_int_eq(mapiproxy_rule_get_property(mem_ctx, &rules->rules[1], PidTagRuleId, &value), MAPI_E_SUCCESS);
+	ck_assert_int_eq(*(uint64_t *) value, 1);
+
+	/* Modified properties replace the old ones */
+	set_rule(&data[0], ROW_MODIFY, 1, 5, 0, NULL);
+	request.RulesCount = 1;
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rules->rules[0].id, 1);
+	ck_assert_int_eq(rules->rules[0].state, 0);
+	ck_assert(rules->rules[0].condition != NULL);
+
+	set_rule(&data[0], ROW_REMOVE, 2, 0, 0, NULL);
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rules->count, 1);
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_NOT_FOUND);
+
+	/* Replace drops the existing rules, ids are not reused */
+	set_rule(&data[0], ROW_ADD, 0, 1, MAPIPROXY_RULE_ENABLED, &res);
+	request.ModifyRulesFlags = ModifyRulesFlag_Replace;
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+	ck_assert_int_eq(rules->count, 1);
+	ck_assert_int_eq(rules->rules[0].id, 3);
+} END_TEST
+
+START_TEST (test_rules_pack) {
+	struct mapiproxy_rules		*rules, *copy;
+	struct ModifyRules_req		request;
+	struct RuleData			data[2];
+	struct mapi_SRestriction	res;
+	DATA_BLOB			blob;
+
+	ck_assert_int_eq(mapiproxy_rules_unpack(mem_ctx, &data_blob_null, &rules), MAPI_E_SUCCESS);
+	set_flags_restriction(&res, MSGFLAG_UNMODIFIED);
+	set_rule(&data[0], ROW_ADD, 0, 1, MAPIPROXY_RULE_ENABLED, &res);
+	set_rule(&data[1], ROW_ADD, 0, 2, MAPIPROXY_RULE_ENABLED|MAPIPROXY_RULE_EXIT_LEVEL, &res);
+	request.ModifyRulesFlags = 0;
+	request.RulesCount = 2;
+	request.RulesData = data;
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+
+	ck_assert_int_eq(mapiproxy_rules_pack(mem_ctx, rules, &blob), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapiproxy_rules_unpack(mem_ctx, &blob, &copy), MAPI_E_SUCCESS);
+	ck_assert_int_eq(copy->count, 2);
+	ck_assert_int_eq(copy->next_id, rules->next_id);
+	ck_assert_int_eq(copy->rules[1].id, rules->rules[1].id);
+	ck_assert_int_eq(copy->rules[1].state, MAPIPROXY_RULE_ENABLED|MAPIPROXY_RULE_EXIT_LEVEL);
+	ck_assert(copy->rules[1].condition != NULL);
+	ck_assert_int_eq(copy->rules[1].actions->count, 1);
+	ck_assert_int_eq(copy->rules[1].actions->ActionBlock[0].ActionBlockData.ActionType, ActionType_OP_MARK_AS_READ);
+
+	/* Truncated data is rejected */
+	blob.length -= 1;
+	ck_assert_int_eq(mapiproxy_rules_unpack(mem_ctx, &blob, &copy), MAPI_E_CORRUPT_DATA);
+} END_TEST
+
+START_TEST (test_rules_evaluate) {
+	struct mapiproxy_rules		*rules;
+	const struct mapiproxy_rule	**matched;
+	struct ModifyRules_req		request;
+	struct RuleData			data[4];
+	struct mapi_SRestriction	res, other, unknown;
+	struct SPropTagArray		*proptags;
+	uint32_t			count;
+
+	set_flags_restriction(&res, MSGFLAG_UNMODIFIED);
+	set_flags_restriction(&other, MSGFLAG_READ);
+	memset(&unknown, 0, sizeof (unknown));
+	unknown.rt = 0xff;
+
+	ck_assert_int_eq(mapiproxy_rules_unpack(mem_ctx, &data_blob_null, &rules), MAPI_E_SUCCESS);
+	set_rule(&data[0], ROW_ADD, 0, 1, MAPIPROXY_RULE_ENABLED, &res);
+	set_rule(&data[1], ROW_ADD, 0, 2, 0, &res);
+	set_rule(&data[2], ROW_ADD, 0, 3, MAPIPROXY_RULE_ENABLED, &other);
+	set_rule(&data[3], ROW_ADD, 0, 4, MAPIPROXY_RULE_ENABLED, &unknown);
+	request.ModifyRulesFlags = 0;
+	request.RulesCount = 4;
+	request.RulesData = data;
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+
+	/* Disabled, non matching and unsupported rules are skipped */
+	ck_assert_int_eq(mapiproxy_rules_evaluate(mem_ctx, rules, get_message_property, NULL, &matched, &count), MAPI_E_SUCCESS);
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(matched[0]->sequence, 1);
+
+	/* Exit level stops the evaluation */
+	set_rule(&data[0], ROW_ADD, 0, 0, MAPIPROXY_RULE_ENABLED|MAPIPROXY_RULE_EXIT_LEVEL, &res);
+	request.RulesCount = 1;
+	ck_assert_int_eq(mapiproxy_rules_modify(rules, &request), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapiproxy_rules_evaluate(mem_ctx, rules, get_message_property, NULL, &matched, &count), MAPI_E_SUCCESS);
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(matched[0]->sequence, 0);
+
+	/* Conditions read a single property */
+	ck_assert_int_eq(mapiproxy_rules_get_proptags(mem_ctx, rules, &proptags), MAPI_E_SUCCESS);
+	ck_assert_int_eq(proptags->cValues, 1);
+	ck_assert_int_eq(proptags->aulPropTag[0], PidTagMessageFlags);
+} END_TEST
+
+Suite *mapiproxy_rules_suite(void)
+{
+	Suite	*s = suite_create("libmapiproxy rules");
+	TCase	*tc;
+
+	tc = tcase_create("mapiproxy_rules");
+	tcase_add_checked_fixture(tc, tc_rules_setup, tc_rules_teardown);
+	tcase_add_test(tc, test_rules_modify);
+	tcase_add_test(tc, test_rules_pack);
+	tcase_add_test(tc, test_rules_evaluate);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,111 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/libmapiproxy/libmapiproxy.h"
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+
+static TALLOC_CTX	*mem_ctx;
+
+static const char * const nodes[] = { "Node1.example.com", "node2.example.com", "node3.example.com", NULL };
+
+static void tc_shard_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "shard_suite");
+}
+
+static void tc_shard_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+/* The values below are also checked by python/openchange/tests/test_shard.py */
+START_TEST (test_shard_hash) {
+	ck_assert_int_eq(mapiproxy_shard_hash(""), 0xab3e7c0b);
+	ck_assert_int_eq(mapiproxy_shard_hash("jdoe"), 0x1d6bcac2);
+	ck_assert_int_eq(mapiproxy_shard_hash("JDoe"), 0x1d6bcac2);
+	ck_assert_int_eq(mapiproxy_shard_hash("node1.example.com#0"), 0x79602f5d);
+} END_TEST
+
+START_TEST (test_shard_lookup) {
+	struct mapiproxy_shard_ring	*ring;
+
+	ck_assert_int_eq(mapiproxy_shard_ring_init(mem_ctx, nodes, 64, &ring), MAPI_E_SUCCESS);
+	ck_assert_int_eq(ring->node_count, 3);
+	ck_assert_int_eq(ring->count, 3 * 64);
+
+	ck_assert_str_eq(mapiproxy_shard_ring_lookup(ring, "jdoe"), "node3.example.com");
+	ck_assert_str_eq(mapiproxy_shard_ring_lookup(ring, "alice"), "node2.example.com");
+	ck_assert_str_eq(mapiproxy_shard_ring_lookup(ring, "carol"), "node1.example.com");
+	ck_assert_str_eq(mapiproxy_shard_ring_lookup(ring, "JDOE"), "node3.example.com");
+	ck_assert(mapiproxy_shard_ring_lookup(ring, NULL) == NULL);
+} END_TEST
+
+START_TEST (test_shard_add_node) {
+	const char * const		more_nodes[] = { "node1.example.com", "node2.example.com", "node3.example.com",
+							 "node4.example.com", NULL };
+	struct mapiproxy_shard_ring	*ring;
+	struct mapiproxy_shard_ring	*bigger;
+	const char			*before;
+	const char			*after;
+	char				*owner;
+	uint32_t			i;
+
+	ck_assert_int_eq(mapiproxy_shard_ring_init(mem_ctx, nodes, 64, &ring), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapiproxy_shard_ring_init(mem_ctx, more_nodes, 64, &bigger), MAPI_E_SUCCESS);
+
+	/* Mailboxes only move to the new node */
+	for (i = 0; i < 1000; i++) {
+		owner = talloc_asprintf(mem_ctx, "user%u", i);
+		before = mapiproxy_shard_ring_lookup(ring, owner);
+		after = mapiproxy_shard_ring_lookup(bigger, owner);
+		if (strcmp(before, after)) {
+			ck_assert_str_eq(after, "node4.example.com");
+		}
+		talloc_free(owner);
+	}
+} END_TEST
+
+START_TEST (test_shard_invalid) {
+	const char * const		no_nodes[] = { NULL };
+	struct mapiproxy_shard_ring	*ring;
+
+	ck_assert_int_eq(mapiproxy_shard_ring_init(mem_ctx, no_nodes, 64, &ring), MAPI_E_INVALID_PARAMETER);
+	ck_assert_int_eq(mapiproxy_shard_ring_init(mem_ctx, nodes, 0, &ring), MAPI_E_INVALID_PARAMETER);
+	ck_assert(mapiproxy_shard_ring_lookup(NULL, "jdoe") == NULL);
+} END_TEST
+
+Suite *mapiproxy_shard_suite(void)
+{
+	Suite	*s = suite_create("libmapiproxy shard");
+	TCase	*tc;
+
+	tc = tcase_create("mapiproxy_shard");
+	tcase_add_checked_fixture(tc, tc_shard_setup, tc_shard_teardown);
+	tcase_add_test(tc, test_shard_hash);
+	tcase_add_test(tc, test_shard_lookup);
+	tcase_add_test(tc, test_shard_add_node);
+	tcase_add_test(tc, test_shard_invalid);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,114 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "mapiproxy/libmapiserver/libmapiserver.h"
+
+static void set_contents_notify(struct EcDoRpc_MAPI_REPL *notify, uint32_t handle,
+				enum RichTableNotificationType event, uint64_t mid)
+{
+	struct ContentsTableChange	*change;
+
+	memset(notify, 0, sizeof (*notify));
+	notify->opnum = op_MAPI_Notify;
+	notify->u.mapi_Notify.NotificationHandle = handle;
+	notify->u.mapi_Notify.NotificationType = fnevMbit | fnevTableModified;
+
+	change = &notify->u.mapi_Notify.NotificationData.ContentsTableChange;
+	change->TableEvent = event;
+	change->ContentsTableChangeUnion.ContentsRowModifiedNotification.FID = 0x1;
+	change->ContentsTableChangeUnion.ContentsRowModifiedNotification.MID = mid;
+}
+
+static void set_newmail_notify(struct EcDoRpc_MAPI_REPL *notify, uint32_t handle)
+{
+	memset(notify, 0, sizeof (*notify));
+	notify->opnum = op_MAPI_Notify;
+	notify->u.mapi_Notify.NotificationHandle = handle;
+	notify->u.mapi_Notify.NotificationType = fnevMbit | fnevNewMail;
+}
+
+START_TEST (test_notify_coalesce_rows) {
+	struct EcDoRpc_MAPI_REPL	notify[4];
+	uint32_t			count;
+
+	set_contents_notify(&notify[0], 1, TABLE_ROW_MODIFIED, 10);
+	set_contents_notify(&notify[1], 1, TABLE_ROW_MODIFIED, 11);
+	set_newmail_notify(&notify[2], 2);
+	set_contents_notify(&notify[3], 1, TABLE_ROW_MODIFIED, 10);
+
+	/* The first modification of row 10 is superseded */
+	count = libmapiserver_RopNotify_coalesce(notify, 4, 0);
+	ck_assert_int_eq(count, 3);
+	ck_assert_int_eq(notify[0].u.mapi_Notify.NotificationData.ContentsTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification.MID, 11);
+	ck_assert_int_eq(notify[1].u.mapi_Notify.NotificationType, fnevMbit | fnevNewMail);
+	ck_assert_int_eq(notify[2].u.mapi_Notify.NotificationData.ContentsTableChange.ContentsTableChangeUnion.ContentsRowModifiedNotification.MID, 10);
+
+	/* Rows of other subscriptions are left alone */
+	set_contents_notify(&notify[0], 1, TABLE_ROW_MODIFIED, 10);
+	set_contents_notify(&notify[1], 3, TABLE_ROW_MODIFIED, 10);
+	count = libmapiserver_RopNotify_coalesce(notify, 2, 0);
+	ck_assert_int_eq(count, 2);
+} END_TEST
+
+START_TEST (test_notify_coalesce_threshold) {
+	struct EcDoRpc_MAPI_REPL	notify[5];
+	uint32_t			count;
+
+	set_contents_notify(&notify[0], 1, TABLE_ROW_ADDED, 10);
+	set_contents_notify(&notify[1], 1, TABLE_ROW_ADDED, 11);
+	set_newmail_notify(&notify[2], 2);
+	set_contents_notify(&notify[3], 1, TABLE_ROW_DELETED, 12);
+	set_contents_notify(&notify[4], 3, TABLE_ROW_ADDED, 13);
+
+	/* Below the threshold nothing is merged */
+	count = libmapiserver_RopNotify_coalesce(notify, 5, 4);
+	ck_assert_int_eq(count, 5);
+
+	count = libmapiserver_RopNotify_coalesce(notify, 5, 3);
+	ck_assert_int_eq(count, 3);
+	ck_assert_int_eq(notify[0].u.mapi_Notify.NotificationHandle, 1);
+	ck_assert_int_eq(notify[0].u.mapi_Notify.NotificationData.ContentsTableChange.TableEvent, TABLE_CHANGED);
+	ck_assert_int_eq(notify[1].u.mapi_Notify.NotificationHandle, 2);
+	ck_assert_int_eq(notify[2].u.mapi_Notify.NotificationHandle, 3);
+	ck_assert_int_eq(notify[2].u.mapi_Notify.NotificationData.ContentsTableChange.TableEvent, TABLE_ROW_ADDED);
+
+	/* A pending TABLE_CHANGED absorbs the row events of its table */
+	set_contents_notify(&notify[0], 1, TABLE_ROW_ADDED, 10);
+	set_contents_notify(&notify[1], 1, TABLE_CHANGED, 0);
+	count = libmapiserver_RopNotify_coalesce(notify, 2, 0);
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(notify[0].u.mapi_Notify.NotificationData.ContentsTableChange.TableEvent, TABLE_CHANGED);
+} END_TEST
+
+Suite *libmapiserver_oxcnotif_suite(void)
+{
+	Suite	*s = suite_create("libmapiserver oxcnotif");
+	TCase	*tc;
+
+	tc = tcase_create("RopNotify coalescing");
+	tcase_add_test(tc, test_notify_coalesce_rows);
+	tcase_add_test(tc, test_notify_coalesce_threshold);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,159 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "libmapi/libmapi.h"
+#include "mapiproxy/libmapiserver/libmapiserver.h"
+
+#define	ROW_PROPS	8
+
+static TALLOC_CTX		*mem_ctx;
+static enum MAPITAGS		tags[ROW_PROPS] = {
+	PidTagMessageFlags, PidTagHasAttachments, PidTagImportance, PidTagMid,
+	PidTagLastModificationTime, PidTagSubject, PidTagMessageClass, PidTagInstanceKey
+};
+static uint32_t			flags = 0x1;
+static uint8_t			attach = 1;
+static uint32_t			importance = 2;
+static uint64_t			mid = 0x123456789ULL;
+static struct FILETIME		ft = { 0x11223344, 0x55667788 };
+static uint8_t			key[] = { 0x01, 0x02, 0x03, 0x04, 0x05 };
+static struct Binary_r		bin = { sizeof (key), key };
+static void			*values[ROW_PROPS];
+
+/* The row as pushed property by property */
+static DATA_BLOB push_row_generic(const enum MAPISTATUS *retvals, const bool *untyped,
+				  uint8_t flagged, bool row_flag)
+{
+	DATA_BLOB	blob = { NULL, 0 };
+	uint32_t	property, retval;
+	void		*data;
+	uint16_t	i;
+
+	if (row_flag) {
+		libmapiserver_push_property(mem_ctx, flagged ? 0x0000000b : 0x00000000,
+					    &flagged, &blob, 0, !flagged, 0);
+	}
+	for (i = 0; i < ROW_PROPS; i++) {
+		retval = retvals[i];
+		if (retval != MAPI_E_SUCCESS) {
+			property = (tags[i] & 0xFFFF0000) + PT_ERROR;
+			data = &retval;
+		}
+		else {
+			property = tags[i];
+			data = values[i];
+		}
+		libmapiserver_push_property(mem_ctx, property, data, &blob,
+					    flagged ? PT_ERROR : 0, flagged, untyped ? untyped[i] : 0);
+	}
+
+	return blob;
+}
+
+static void check_row(const enum MAPISTATUS *retvals, const bool *untyped, uint8_t flagged, bool row_flag)
+{
+	DATA_BLOB	expected;
+	DATA_BLOB	blob = { NULL, 0 };
+	int		ret;
+
+	expected = push_row_generic(retvals, untyped, flagged, row_flag);
+	ret = libmapiserver_push_property_row(mem_ctx, &blob, ROW_PROPS, tags, values,
+					      retvals, untyped, flagged, row_flag);
+	ck_assert_int_eq(ret, 0);
+	ck_assert_int_eq(blob.length, expected.length);
+	ck_assert(memcmp(blob.data, expected.data, blob.length) == 0);
+}
+
+static void tc_push_property_row_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "tc_push_property_row");
+
+	values[0] = &flags;
+	values[1] = &attach;
+	values[2] = &importance;
+	values[3] = &mid;
+	values[4] = &ft;
+	values[5] = talloc_strdup(mem_ctx, "Subject of the message");
+	values[6] = talloc_strdup(mem_ctx, "IPM.Note");
+	values[7] = &bin;
+}
+
+static void tc_push_property_row_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+START_TEST (test_push_property_row_table) {
+	enum MAPISTATUS	retvals[ROW_PROPS] = { MAPI_E_SUCCESS };
+
+	check_row(retvals, NULL, 0, true);
+
+	retvals[2] = MAPI_E_NOT_FOUND;
+	retvals[6] = MAPI_E_NOT_ENOUGH_MEMORY;
+	check_row(retvals, NULL, 1, true);
+} END_TEST
+
+START_TEST (test_push_property_row_untyped) {
+	enum MAPISTATUS	retvals[ROW_PROPS] = { MAPI_E_SUCCESS };
+	bool		untyped[ROW_PROPS] = { false };
+
+	check_row(retvals, untyped, 0, false);
+
+	untyped[3] = true;
+	untyped[5] = true;
+	retvals[7] = MAPI_E_NOT_FOUND;
+	check_row(retvals, untyped, 1, false);
+} END_TEST
+
+START_TEST (test_push_property_row_append) {
+	enum MAPISTATUS	retvals[ROW_PROPS] = { MAPI_E_SUCCESS };
+	DATA_BLOB	expected;
+	DATA_BLOB	blob = { NULL, 0 };
+	DATA_BLOB	row;
+	uint32_t	i;
+
+	/* Rows of a QueryRows reply, one after another */
+	row = push_row_generic(retvals, NULL, 0, true);
+	expected = data_blob_talloc(mem_ctx, NULL, 0);
+	for (i = 0; i < 50; i++) {
+		data_blob_append(mem_ctx, &expected, row.data, row.length);
+		ck_assert_int_eq(libmapiserver_push_property_row(mem_ctx, &blob, ROW_PROPS, tags, values,
+								 retvals, NULL, 0, true), 0);
+	}
+	ck_assert_int_eq(blob.length, expected.length);
+	ck_assert(memcmp(blob.data, expected.data, blob.length) == 0);
+} END_TEST
+
+Suite *libmapiserver_oxcprpt_suite(void)
+{
+	Suite	*s = suite_create("libmapiserver oxcprpt");
+	TCase	*tc;
+
+	tc = tcase_create("PropertyRow serialization");
+	tcase_add_checked_fixture(tc, tc_push_property_row_setup, tc_push_property_row_teardown);
+	tcase_add_test(tc, test_push_property_row_table);
+	tcase_add_test(tc, test_push_property_row_untyped);
+	tcase_add_test(tc, test_push_property_row_append);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,138 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+
+
+START_TEST(test_attachments_single_instance) {
+	TALLOC_CTX		*mem_ctx;
+	DATA_BLOB		data, other, piece;
+	char			*key, *key2, *key3;
+	uint64_t		size;
+
+	mem_ctx = talloc_new(NULL);
+
+	data = data_blob_string_const("attachment sent to many mailboxes");
+	other = data_blob_string_const("another attachment");
+
+	/* The same content is stored once */
+	ck_assert_int_eq(mapistore_attachment_store_put(mem_ctx, g_mstore_ctx, data, &key), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_attachment_store_put(mem_ctx, g_mstore_ctx, data, &key2), MAPISTORE_SUCCESS);
+	ck_assert_str_eq(key, key2);
+	ck_assert_int_eq(mapistore_attachment_store_put(mem_ctx, g_mstore_ctx, other, &key3), MAPISTORE_SUCCESS);
+	ck_assert_str_ne(key, key3);
+
+	ck_assert_int_eq(mapistore_attachment_store_get_size(g_mstore_ctx, key, &size), MAPISTORE_SUCCESS);
+	ck_assert(size == data.length);
+
+	/* Pieces are read from any offset, shorter at the end */
+	ck_assert_int_eq(mapistore_attachment_store_read(mem_ctx, g_mstore_ctx, key, 11, 4, &piece), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(piece.length, 4);
+	ck_assert(memcmp(piece.data, "sent", 4) == 0);
+	ck_assert_int_eq(mapistore_attachment_store_read(mem_ctx, g_mstore_ctx, key, data.length - 5, 100, &piece),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(piece.length, 5);
+	ck_assert(memcmp(piece.data, "boxes", 5) == 0);
+
+	/* The content goes away with its last reference */
+	ck_assert_int_eq(mapistore_attachment_store_release(g_mstore_ctx, key), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_attachment_store_get_size(g_mstore_ctx, key, &size), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_attachment_store_release(g_mstore_ctx, key), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_attachment_store_get_size(g_mstore_ctx, key, &size), MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(mapistore_attachment_store_release(g_mstore_ctx, key), MAPISTORE_ERR_NOT_FOUND);
+
+	ck_assert_int_eq(mapistore_attachment_store_release(g_mstore_ctx, key3), MAPISTORE_SUCCESS);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_attachments_keys) {
+	TALLOC_CTX		*mem_ctx;
+	DATA_BLOB		piece;
+	char			*key;
+
+	mem_ctx = talloc_new(NULL);
+
+	/* Keys never name files outside of the store */
+	ck_assert_int_eq(mapistore_attachment_store_read(mem_ctx, g_mstore_ctx, "../../etc/passwd", 0, 4, &piece),
+			 MAPISTORE_ERR_INVALID_PARAMETER);
+	ck_assert_int_eq(mapistore_attachment_store_release(g_mstore_ctx, "/tmp"), MAPISTORE_ERR_INVALID_PARAMETER);
+
+	/* Nothing is stored when disabled */
+	mapistore_set_attachment_store(false);
+	ck_assert(!mapistore_attachment_store_enabled());
+	ck_assert_int_eq(mapistore_attachment_store_put(mem_ctx, g_mstore_ctx, data_blob_string_const("data"), &key),
+			 MAPISTORE_ERR_NOT_AVAILABLE);
+	mapistore_set_attachment_store(true);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tdb_setup(void)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_set_mapping_path("/tmp/");
+	ck_assert(retval == MAPISTORE_SUCCESS);
+	mapistore_set_attachment_store(true);
+
+	/* the attachment store functions only check the context is initialized */
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+	g_mstore_ctx->processing_ctx = talloc_zero(g_mstore_ctx, struct processing_context);
+	g_mstore_ctx->context_list = talloc_zero(g_mstore_ctx, struct backend_context_list);
+}
+
+static void tdb_teardown(void)
+{
+	char *db_file = NULL;
+
+	db_file = talloc_asprintf(g_mstore_ctx, "%sattachments/%s",
+				  mapistore_get_mapping_path(),
+				  MAPISTORE_DB_ATTACHMENTS);
+	unlink(db_file);
+	talloc_free(g_mstore_ctx);
+}
+
+Suite *mapistore_attachments_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("libmapistore attachments");
+
+	tc = tcase_create("attachments: single-instance store");
+	tcase_add_checked_fixture(tc, tdb_setup, tdb_teardown);
+	tcase_add_test(tc, test_attachments_single_instance);
+	tcase_add_test(tc, test_attachments_keys);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,237 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+
+/* The folder id the fake backend blocks on until it is released */
+#define	BLOCKING_FID	0x1
+
+/* Global test variables */
+static struct mapistore_backend	g_backend;
+static struct backend_context	g_slow_ctx;
+static struct backend_context	g_other_ctx;
+
+/* Stands for the emsmdb lock held by the worker threads */
+static pthread_mutex_t		g_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread bool		g_lock_held = false;
+
+static pthread_mutex_t		g_state_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		g_state_cond = PTHREAD_COND_INITIALIZER;
+static int			g_blocked;
+static bool			g_released;
+static int			g_running;
+static int			g_running_max;
+static int			g_calls;
+
+
+static bool test_leave(void)
+{
+	if (!g_lock_held) return false;
+
+	g_lock_held = false;
+	pthread_mutex_unlock(&g_lock);
+	return true;
+}
+
+static void test_enter(void)
+{
+	pthread_mutex_lock(&g_lock);
+	g_lock_held = true;
+}
+
+static enum mapistore_error test_open_folder(void *folder, TALLOC_CTX *mem_ctx, uint64_t fid, void **child_folder)
+{
+	pthread_mutex_lock(&g_state_lock);
+	g_calls++;
+	if (++g_running > g_running_max) {
+		g_running_max = g_running;
+	}
+	if (fid == BLOCKING_FID) {
+		g_blocked++;
+		pthread_cond_broadcast(&g_state_cond);
+		while (!g_released) {
+			pthread_cond_wait(&g_state_cond, &g_state_lock);
+		}
+	}
+	g_running--;
+	pthread_cond_broadcast(&g_state_cond);
+	pthread_mutex_unlock(&g_state_lock);
+
+	*child_folder = NULL;
+	return MAPISTORE_SUCCESS;
+}
+
+/* A worker thread running a call of the slow session */
+static void *test_slow_call(void *arg)
+{
+	struct backend_context	*bctx = (struct backend_context *) arg;
+	void			*child;
+	enum mapistore_error	retval;
+
+	test_enter();
+	retval = mapistore_backend_folder_open_folder(bctx, NULL, NULL, BLOCKING_FID, &child);
+	test_leave();
+
+	return (void *)(intptr_t) retval;
+}
+
+static void test_wait_blocked(int count)
+{
+	pthread_mutex_lock(&g_state_lock);
+	while (g_blocked < count) {
+		pthread_cond_wait(&g_state_cond, &g_state_lock);
+	}
+	pthread_mutex_unlock(&g_state_lock);
+}
+
+static void test_release(void)
+{
+	pthread_mutex_lock(&g_state_lock);
+	g_released = true;
+	pthread_cond_broadcast(&g_state_cond);
+	pthread_mutex_unlock(&g_state_lock);
+}
+
+
+START_TEST(test_thread_safe_backend_releases_lock) {
+	pthread_t		thread;
+	struct timespec		deadline;
+	void			*child;
+	void			*ret;
+	enum mapistore_error	retval;
+
+	g_backend.backend.flags = MAPISTORE_BACKEND_THREAD_SAFE;
+
+	ck_assert(pthread_create(&thread, NULL, test_slow_call, &g_slow_ctx) == 0);
+	test_wait_blocked(1);
+
+	/* The call of an unrelated session gets the lock and completes */
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += 5;
+	ck_assert_int_eq(pthread_mutex_timedlock(&g_lock, &deadline), 0);
+	g_lock_held = true;
+	retval = mapistore_backend_folder_open_folder(&g_other_ctx, NULL, NULL, 0x2, &child);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	test_leave();
+
+	ck_assert_int_eq(g_calls, 2);
+	ck_assert_int_eq(g_blocked, 1);
+
+	test_release();
+	ck_assert(pthread_join(thread, &ret) == 0);
+	ck_assert_int_eq((intptr_t) ret, MAPISTORE_SUCCESS);
+} END_TEST
+
+START_TEST(test_other_backend_keeps_lock) {
+	pthread_t		thread;
+	void			*ret;
+
+	g_backend.backend.flags = 0;
+
+	ck_assert(pthread_create(&thread, NULL, test_slow_call, &g_slow_ctx) == 0);
+	test_wait_blocked(1);
+
+	/* Backends not flagged thread safe still run under the lock */
+	ck_assert_int_eq(pthread_mutex_trylock(&g_lock), EBUSY);
+
+	test_release();
+	ck_assert(pthread_join(thread, &ret) == 0);
+	ck_assert_int_eq((intptr_t) ret, MAPISTORE_SUCCESS);
+} END_TEST
+
+START_TEST(test_same_context_serialized) {
+	pthread_t		threads[2];
+	void			*ret;
+	int			i;
+
+	g_backend.backend.flags = MAPISTORE_BACKEND_THREAD_SAFE;
+
+	for (i = 0; i < 2; i++) {
+		ck_assert(pthread_create(&threads[i], NULL, test_slow_call, &g_slow_ctx) == 0);
+	}
+	test_wait_blocked(1);
+	/* Give the second call the time to reach the backend if it could */
+	usleep(100000);
+	pthread_mutex_lock(&g_state_lock);
+	ck_assert_int_eq(g_blocked, 1);
+	pthread_mutex_unlock(&g_state_lock);
+
+	test_release();
+	for (i = 0; i < 2; i++) {
+		ck_assert(pthread_join(threads[i], &ret) == 0);
+		ck_assert_int_eq((intptr_t) ret, MAPISTORE_SUCCESS);
+	}
+	ck_assert_int_eq(g_calls, 2);
+	ck_assert_int_eq(g_running_max, 1);
+} END_TEST
+
+
+static void backend_threads_setup(void)
+{
+	memset(&g_backend, 0, sizeof (g_backend));
+	g_backend.backend.name = "threadstest";
+	g_backend.folder.open_folder = test_open_folder;
+
+	memset(&g_slow_ctx, 0, sizeof (g_slow_ctx));
+	g_slow_ctx.backend = &g_backend;
+	g_slow_ctx.uri = (char *) "threadstest://slow/";
+
+	memset(&g_other_ctx, 0, sizeof (g_other_ctx));
+	g_other_ctx.backend = &g_backend;
+	g_other_ctx.uri = (char *) "threadstest://other/";
+
+	g_blocked = 0;
+	g_released = false;
+	g_running = 0;
+	g_running_max = 0;
+	g_calls = 0;
+
+	mapistore_set_backend_profiling(false, 0);
+	mapistore_set_backend_call_hooks(test_leave, test_enter);
+}
+
+static void backend_threads_teardown(void)
+{
+	mapistore_set_backend_call_hooks(NULL, NULL);
+}
+
+Suite *mapistore_backend_threads_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore backend threads");
+
+	tc = tcase_create("backend threads: call hooks");
+	tcase_add_checked_fixture(tc, backend_threads_setup, backend_threads_teardown);
+	tcase_add_test(tc, test_thread_safe_backend_releases_lock);
+	tcase_add_test(tc, test_other_backend_keeps_lock);
+	tcase_add_test(tc, test_same_context_serialized);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
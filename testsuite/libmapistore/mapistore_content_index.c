@@ -0,0 +1,266 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define CONTENT_INDEX_TEST_FID		0x0000000000190001ULL
+#define CONTENT_INDEX_TEST_FID_NONE	0x0000000000200001ULL
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+static const char		*g_test_username = "contentindextestuser";
+
+/* test helpers */
+static void _add(uint64_t mid, const char *subject, const char *body, bool partial)
+{
+	enum MAPITAGS		proptags[2] = { PidTagSubject, PidTagBody };
+	const char		*texts[2];
+	enum mapistore_error	retval;
+
+	texts[0] = subject;
+	texts[1] = body;
+	retval = mapistore_content_index_add(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID, mid,
+					     2, proptags, texts, partial);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+}
+
+static void _set_content(struct mapi_SRestriction *res, enum MAPITAGS proptag, uint32_t fuzzy, const char *needle)
+{
+	memset(res, 0, sizeof (*res));
+	res->rt = RES_CONTENT;
+	res->res.resContent.fuzzy = fuzzy;
+	res->res.resContent.ulPropTag = proptag;
+	res->res.resContent.lpProp.ulPropTag = proptag;
+	res->res.resContent.lpProp.value.lpszW = needle;
+}
+
+static uint32_t _query(TALLOC_CTX *mem_ctx, const struct mapi_SRestriction *res, uint64_t **mids)
+{
+	enum mapistore_error	retval;
+	uint32_t		count = 0;
+
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID,
+					       res, mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	return count;
+}
+
+
+START_TEST(test_content_index_query) {
+	TALLOC_CTX			*mem_ctx;
+	struct mapi_SRestriction	res;
+	uint64_t			*mids;
+	uint32_t			count;
+
+	mem_ctx = talloc_new(NULL);
+
+	ck_assert_int_eq(mapistore_content_index_folder_reset(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID),
+			 MAPISTORE_SUCCESS);
+	ck_assert(mapistore_content_index_folder_exists(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID));
+	_add(0x30001, "Quarterly report", "Numbers are attached", false);
+	_add(0x10001, "Lunch", "See the REPORT from yesterday", false);
+	_add(0x20001, "Holidays", "Out of office", false);
+
+	/* Case is ignored, fields are kept apart */
+	_set_content(&res, PidTagSubject, FL_SUBSTRING|FL_IGNORECASE, "REPORT");
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 1);
+	ck_assert(mids[0] == 0x30001);
+
+	_set_content(&res, PidTagBody, FL_SUBSTRING, "report");
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 1);
+	ck_assert(mids[0] == 0x10001);
+
+	/* Normalized subjects are searched in the subjects */
+	_set_content(&res, PidTagNormalizedSubject, FL_PREFIX, "Holi");
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 1);
+	ck_assert(mids[0] == 0x20001);
+
+	_set_content(&res, PidTagSubject, FL_SUBSTRING, "missing");
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 0);
+
+	/* Saved messages replace their previous text */
+	_add(0x30001, "Quarterly figures", NULL, false);
+	_set_content(&res, PidTagSubject, FL_SUBSTRING, "report");
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 0);
+
+	/* Partially indexed messages are always candidates */
+	_add(0x40001, "Travel", NULL, true);
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 1);
+	ck_assert(mids[0] == 0x40001);
+
+	ck_assert_int_eq(mapistore_content_index_del(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID, 1, &mids[0]),
+			 MAPISTORE_SUCCESS);
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 0);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_content_index_plan) {
+	TALLOC_CTX			*mem_ctx;
+	struct mapi_SRestriction	res, children[2];
+	uint64_t			*mids;
+	uint32_t			count;
+	enum mapistore_error		retval;
+
+	mem_ctx = talloc_new(NULL);
+
+	ck_assert_int_eq(mapistore_content_index_folder_reset(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID),
+			 MAPISTORE_SUCCESS);
+	_add(0x10001, "Budget meeting", "Agenda", false);
+	_add(0x20001, "Budget review", "Minutes", false);
+	_add(0x30001, "Team meeting", "Agenda", false);
+
+	/* Conjunctions intersect their answerable members */
+	_set_content(&children[0], PidTagSubject, FL_SUBSTRING, "budget");
+	memset(&children[1], 0, sizeof (children[1]));
+	children[1].rt = RES_EXIST;
+	children[1].res.resExist.ulPropTag = PidTagImportance;
+	memset(&res, 0, sizeof (res));
+	res.rt = RES_AND;
+	res.res.resAnd.cRes = 2;
+	res.res.resAnd.res = (struct mapi_SRestriction_and *)children;
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 2);
+	ck_assert(mids[0] == 0x10001);
+	ck_assert(mids[1] == 0x20001);
+
+	/* Disjunctions need every member to be answerable */
+	res.rt = RES_OR;
+	res.res.resOr.cRes = 2;
+	res.res.resOr.res = (struct mapi_SRestriction_or *)children;
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID,
+					       &res, &mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	_set_content(&children[1], PidTagBody, FL_FULLSTRING, "Agenda");
+	count = _query(mem_ctx, &res, &mids);
+	ck_assert_int_eq(count, 3);
+
+	/* Short, loose and non indexed searches are not answered */
+	_set_content(&res, PidTagSubject, FL_SUBSTRING, "me");
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID,
+					       &res, &mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+	_set_content(&res, PidTagSubject, FL_SUBSTRING|FL_LOOSE, "meeting");
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID,
+					       &res, &mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+	_set_content(&res, PidTagMessageClass, FL_SUBSTRING, "IPM.Note");
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID,
+					       &res, &mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_content_index_folders) {
+	TALLOC_CTX			*mem_ctx;
+	struct mapi_SRestriction	res;
+	enum MAPITAGS			proptag = PidTagSubject;
+	const char			*text = "Not indexed";
+	uint64_t			*mids;
+	uint32_t			count;
+	enum mapistore_error		retval;
+
+	mem_ctx = talloc_new(NULL);
+
+	/* Folders which were never built are not maintained */
+	retval = mapistore_content_index_add(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID_NONE, 0x10001,
+					     1, &proptag, &text, false);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(!mapistore_content_index_folder_exists(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID_NONE));
+	_set_content(&res, PidTagSubject, FL_SUBSTRING, "indexed");
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID_NONE,
+					       &res, &mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	ck_assert_int_eq(mapistore_content_index_folder_reset(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID),
+			 MAPISTORE_SUCCESS);
+	_add(0x10001, "Indexed subject", NULL, false);
+	ck_assert_int_eq(mapistore_content_index_folder_invalidate(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID),
+			 MAPISTORE_SUCCESS);
+	ck_assert(!mapistore_content_index_folder_exists(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID));
+
+	/* Nothing is answered when the index is disabled */
+	ck_assert_int_eq(mapistore_content_index_folder_reset(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID),
+			 MAPISTORE_SUCCESS);
+	mapistore_set_content_index(false);
+	ck_assert(!mapistore_content_index_folder_exists(g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID));
+	retval = mapistore_content_index_query(mem_ctx, g_mstore_ctx, g_test_username, CONTENT_INDEX_TEST_FID,
+					       &res, &mids, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+static void tdb_setup(void)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_set_mapping_path("/tmp/");
+	ck_assert(retval == MAPISTORE_SUCCESS);
+	mapistore_set_content_index(true);
+
+	/* the content index functions only check the context is initialized */
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+	g_mstore_ctx->processing_ctx = talloc_zero(g_mstore_ctx, struct processing_context);
+	g_mstore_ctx->context_list = talloc_zero(g_mstore_ctx, struct backend_context_list);
+}
+
+static void tdb_teardown(void)
+{
+	char *index_file = NULL;
+
+	index_file = talloc_asprintf(g_mstore_ctx, "%s%s/%s",
+				     mapistore_get_mapping_path(),
+				     g_test_username,
+				     MAPISTORE_DB_CONTENT_INDEX);
+	unlink(index_file);
+	talloc_free(g_mstore_ctx);
+}
+
+Suite *mapistore_content_index_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore content index");
+
+	tc = tcase_create("content index: TDB storage");
+	tcase_add_checked_fixture(tc, tdb_setup, tdb_teardown);
+	tcase_add_test(tc, test_content_index_query);
+	tcase_add_test(tc, test_content_index_plan);
+	tcase_add_test(tc, test_content_index_folders);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
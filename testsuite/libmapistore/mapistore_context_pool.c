@@ -0,0 +1,190 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define	POOL_TEST_URI_1		"fake://pooltestuser/inbox/"
+#define	POOL_TEST_URI_2		"fake://pooltestuser/calendar/"
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+static struct indexing_context	*g_ictx = NULL;
+static const char		*g_test_username = "pooltestuser";
+
+/* test helpers */
+static struct mapistore_context *_session_new(void)
+{
+	struct mapistore_context	*mstore_ctx;
+
+	mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(mstore_ctx != NULL);
+	mstore_ctx->conn_info = talloc_zero(mstore_ctx, struct mapistore_connection_info);
+	mstore_ctx->conn_info->mstore_ctx = mstore_ctx;
+	mstore_ctx->conn_info->username = talloc_strdup(mstore_ctx->conn_info, g_test_username);
+
+	return mstore_ctx;
+}
+
+static struct backend_context *_backend_ctx_new(struct mapistore_context *mstore_ctx, const char *uri)
+{
+	struct backend_context	*backend_ctx;
+
+	backend_ctx = talloc_zero(mstore_ctx, struct backend_context);
+	ck_assert(backend_ctx != NULL);
+	backend_ctx->uri = talloc_strdup(backend_ctx, uri);
+	backend_ctx->indexing = g_ictx;
+	backend_ctx->ref_count = 1;
+	backend_ctx->conn_info = talloc_zero(backend_ctx, struct mapistore_connection_info);
+	mapistore_context_pool_bind_conn_info(backend_ctx->conn_info, mstore_ctx->conn_info);
+
+	return backend_ctx;
+}
+
+
+START_TEST(test_pool_disabled) {
+	struct backend_context	*backend_ctx;
+	enum mapistore_error	retval;
+
+	mapistore_set_context_pool(0, MAPISTORE_CONTEXT_POOL_SIZE);
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_1);
+
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+} END_TEST
+
+START_TEST(test_pool_reuse) {
+	struct mapistore_context	*mstore_ctx;
+	struct backend_context		*backend_ctx, *pooled_ctx;
+	enum mapistore_error		retval;
+
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_1);
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(backend_ctx->ref_count, 0);
+
+	/* a new session of the same user gets the context back */
+	mstore_ctx = _session_new();
+	ck_assert(mapistore_context_pool_get_indexing(g_test_username) == g_ictx);
+
+	retval = mapistore_context_pool_take(mstore_ctx, g_ictx, POOL_TEST_URI_2, &pooled_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	retval = mapistore_context_pool_take(mstore_ctx, g_ictx, POOL_TEST_URI_1, &pooled_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(pooled_ctx == backend_ctx);
+	ck_assert_int_eq(pooled_ctx->ref_count, 1);
+	ck_assert(pooled_ctx->conn_info->mstore_ctx == mstore_ctx);
+	ck_assert(talloc_parent(pooled_ctx) == mstore_ctx);
+
+	/* the context left the pool */
+	retval = mapistore_context_pool_take(mstore_ctx, g_ictx, POOL_TEST_URI_1, &pooled_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(mstore_ctx);
+} END_TEST
+
+START_TEST(test_pool_refused) {
+	struct backend_context		*backend_ctx, *pooled_ctx;
+	struct indexing_context		*ictx;
+	enum mapistore_error		retval;
+
+	/* contexts whose root folder was deleted are not kept */
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_1);
+	backend_ctx->root_deleted = true;
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	/* contexts created without a connection info of their own neither */
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_1);
+	talloc_free(backend_ctx->conn_info);
+	backend_ctx->conn_info = NULL;
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	/* a session using another indexing context can't reuse it */
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_1);
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	ictx = talloc_zero(g_mstore_ctx, struct indexing_context);
+	ictx->url = talloc_strdup(ictx, g_test_username);
+	retval = mapistore_context_pool_take(g_mstore_ctx, ictx, POOL_TEST_URI_1, &pooled_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+	ck_assert(mapistore_context_pool_get_indexing(g_test_username) == NULL);
+} END_TEST
+
+START_TEST(test_pool_size) {
+	struct backend_context		*backend_ctx, *pooled_ctx;
+	enum mapistore_error		retval;
+
+	mapistore_set_context_pool(60, 1);
+
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_1);
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	backend_ctx = _backend_ctx_new(g_mstore_ctx, POOL_TEST_URI_2);
+	retval = mapistore_context_pool_park(g_mstore_ctx, backend_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	/* the oldest context was dropped */
+	retval = mapistore_context_pool_take(g_mstore_ctx, g_ictx, POOL_TEST_URI_1, &pooled_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+	retval = mapistore_context_pool_take(g_mstore_ctx, g_ictx, POOL_TEST_URI_2, &pooled_ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+} END_TEST
+
+
+static void pool_setup(void)
+{
+	mapistore_set_context_pool(60, MAPISTORE_CONTEXT_POOL_SIZE);
+
+	g_mstore_ctx = _session_new();
+	g_ictx = talloc_zero(g_mstore_ctx, struct indexing_context);
+	ck_assert(g_ictx != NULL);
+	g_ictx->url = talloc_strdup(g_ictx, g_test_username);
+}
+
+static void pool_teardown(void)
+{
+	talloc_free(g_mstore_ctx);
+	mapistore_set_context_pool(0, MAPISTORE_CONTEXT_POOL_SIZE);
+}
+
+Suite *mapistore_context_pool_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore context pool");
+
+	tc = tcase_create("context pool: park and reuse");
+	tcase_add_checked_fixture(tc, pool_setup, pool_teardown);
+	tcase_add_test(tc, test_pool_disabled);
+	tcase_add_test(tc, test_pool_reuse);
+	tcase_add_test(tc, test_pool_refused);
+	tcase_add_test(tc, test_pool_size);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
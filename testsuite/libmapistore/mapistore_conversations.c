@@ -0,0 +1,177 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define	CONVERSATIONS_USER	"conversations_user"
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+static const uint8_t		g_thread[MAPISTORE_CONVERSATION_ID_SIZE] = "thread-one-----";
+static const uint8_t		g_other[MAPISTORE_CONVERSATION_ID_SIZE] = "thread-two-----";
+
+
+START_TEST(test_conversations_order) {
+	TALLOC_CTX				*mem_ctx;
+	struct mapistore_conversation_member	*members;
+	uint32_t				count;
+	uint8_t					id[MAPISTORE_CONVERSATION_ID_SIZE];
+
+	mem_ctx = talloc_new(NULL);
+
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_thread, 0x1, 0x101, 300), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_thread, 0x2, 0x201, 100), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_thread, 0x1, 0x102, 200), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_other, 0x1, 0x103, 50), MAPISTORE_SUCCESS);
+
+	/* Members of every folder, oldest first */
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_thread, &members, &count),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(count, 3);
+	ck_assert(members[0].mid == 0x201 && members[0].fid == 0x2);
+	ck_assert(members[1].mid == 0x102);
+	ck_assert(members[2].mid == 0x101);
+
+	/* Saving a message again moves it to its new conversation */
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_other, 0x1, 0x102, 200), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_get_id(g_mstore_ctx, CONVERSATIONS_USER, 0x102, id), MAPISTORE_SUCCESS);
+	ck_assert(memcmp(id, g_other, MAPISTORE_CONVERSATION_ID_SIZE) == 0);
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_thread, &members, &count),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(count, 2);
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_other, &members, &count),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(count, 2);
+	ck_assert(members[0].mid == 0x103 && members[1].mid == 0x102);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_conversations_copy_del) {
+	TALLOC_CTX				*mem_ctx;
+	struct mapistore_conversation_member	*members;
+	uint32_t				count;
+	uint64_t				source_mids[2] = { 0x101, 0x999 };
+	uint64_t				target_mids[2] = { 0x301, 0x302 };
+	uint8_t					id[MAPISTORE_CONVERSATION_ID_SIZE];
+
+	mem_ctx = talloc_new(NULL);
+
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_thread, 0x1, 0x101, 100), MAPISTORE_SUCCESS);
+
+	/* Copies join the conversation of their source, unknown sources are ignored */
+	ck_assert_int_eq(mapistore_conversations_copy(g_mstore_ctx, CONVERSATIONS_USER, 0x3, 2, source_mids, target_mids, false),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_thread, &members, &count),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(count, 2);
+	ck_assert_int_eq(mapistore_conversations_get_id(g_mstore_ctx, CONVERSATIONS_USER, 0x302, id), MAPISTORE_ERR_NOT_FOUND);
+
+	/* Moves replace their source */
+	source_mids[0] = 0x301;
+	target_mids[0] = 0x401;
+	ck_assert_int_eq(mapistore_conversations_copy(g_mstore_ctx, CONVERSATIONS_USER, 0x4, 1, source_mids, target_mids, true),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_get_id(g_mstore_ctx, CONVERSATIONS_USER, 0x301, id), MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_thread, &members, &count),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(count, 2);
+	ck_assert(members[1].mid == 0x401 && members[1].fid == 0x4);
+
+	/* The conversation goes away with its last member */
+	source_mids[0] = 0x101;
+	source_mids[1] = 0x401;
+	ck_assert_int_eq(mapistore_conversations_del(g_mstore_ctx, CONVERSATIONS_USER, 2, source_mids), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_thread, &members, &count),
+			 MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(mapistore_conversations_get_id(g_mstore_ctx, CONVERSATIONS_USER, 0x101, id), MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_conversations_disabled) {
+	TALLOC_CTX				*mem_ctx;
+	struct mapistore_conversation_member	*members;
+	uint32_t				count;
+
+	mem_ctx = talloc_new(NULL);
+
+	mapistore_set_conversations(false);
+	ck_assert(!mapistore_conversations_enabled());
+	ck_assert_int_eq(mapistore_conversations_add(g_mstore_ctx, CONVERSATIONS_USER, g_thread, 0x1, 0x101, 100), MAPISTORE_SUCCESS);
+	mapistore_set_conversations(true);
+
+	/* Nothing was indexed */
+	ck_assert_int_eq(mapistore_conversations_get(mem_ctx, g_mstore_ctx, CONVERSATIONS_USER, g_thread, &members, &count),
+			 MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void tdb_setup(void)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_set_mapping_path("/tmp/");
+	ck_assert(retval == MAPISTORE_SUCCESS);
+	mapistore_set_conversations(true);
+
+	/* the conversation index functions only check the context is initialized */
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+	g_mstore_ctx->processing_ctx = talloc_zero(g_mstore_ctx, struct processing_context);
+	g_mstore_ctx->context_list = talloc_zero(g_mstore_ctx, struct backend_context_list);
+}
+
+static void tdb_teardown(void)
+{
+	char *db_file = NULL;
+
+	db_file = talloc_asprintf(g_mstore_ctx, "%s/%s/%s",
+				  mapistore_get_mapping_path(),
+				  CONVERSATIONS_USER,
+				  MAPISTORE_DB_CONVERSATIONS);
+	unlink(db_file);
+	talloc_free(g_mstore_ctx);
+}
+
+Suite *mapistore_conversations_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("libmapistore conversations");
+
+	tc = tcase_create("conversations: index");
+	tcase_add_checked_fixture(tc, tdb_setup, tdb_teardown);
+	tcase_add_test(tc, test_conversations_order);
+	tcase_add_test(tc, test_conversations_copy_del);
+	tcase_add_test(tc, test_conversations_disabled);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
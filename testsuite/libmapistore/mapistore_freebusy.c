@@ -0,0 +1,218 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define FREEBUSY_TEST_FID		0x0000000000190001ULL
+#define FREEBUSY_TEST_FID_NONE		0x0000000000200001ULL
+/* Publishing range, in minutes since 1601 */
+#define FREEBUSY_TEST_START		200000000
+#define FREEBUSY_TEST_END		200131040
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+static const char		*g_test_username = "freebusytestuser";
+
+/* test helpers */
+static void _make_event(struct mapistore_freebusy_event *event, uint64_t mid,
+			uint32_t start_min, uint32_t end_min, uint32_t busy_status)
+{
+	NTTIME	nt;
+
+	event->mid = mid;
+	nt = (NTTIME) start_min * 60 * 10000000ULL;
+	event->start.dwLowDateTime = nt & 0xffffffff;
+	event->start.dwHighDateTime = nt >> 32;
+	nt = (NTTIME) end_min * 60 * 10000000ULL;
+	event->end.dwLowDateTime = nt & 0xffffffff;
+	event->end.dwHighDateTime = nt >> 32;
+	event->busy_status = busy_status;
+}
+
+static void _assert_event_eq(const struct mapistore_freebusy_event *a, const struct mapistore_freebusy_event *b)
+{
+	ck_assert(a->mid == b->mid);
+	ck_assert_int_eq(a->start.dwLowDateTime, b->start.dwLowDateTime);
+	ck_assert_int_eq(a->start.dwHighDateTime, b->start.dwHighDateTime);
+	ck_assert_int_eq(a->end.dwLowDateTime, b->end.dwLowDateTime);
+	ck_assert_int_eq(a->end.dwHighDateTime, b->end.dwHighDateTime);
+	ck_assert_int_eq(a->busy_status, b->busy_status);
+}
+
+static uint32_t _load(TALLOC_CTX *mem_ctx, struct mapistore_freebusy_event **events)
+{
+	enum mapistore_error	retval;
+	uint32_t		count = 0;
+
+	retval = mapistore_freebusy_summary_load(mem_ctx, g_test_username, FREEBUSY_TEST_FID,
+						 FREEBUSY_TEST_START, FREEBUSY_TEST_END, events, &count);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	return count;
+}
+
+
+START_TEST(test_summary_store_load) {
+	TALLOC_CTX			*mem_ctx;
+	struct mapistore_freebusy_event	events[2], *loaded;
+	enum mapistore_error		retval;
+	uint32_t			count;
+
+	mem_ctx = talloc_new(NULL);
+	_make_event(&events[0], 0x10001, FREEBUSY_TEST_START + 60, FREEBUSY_TEST_START + 120, olBusy);
+	_make_event(&events[1], 0x20001, FREEBUSY_TEST_START + 600, FREEBUSY_TEST_START + 660, olTentative);
+
+	/* no summary yet */
+	retval = mapistore_freebusy_summary_load(mem_ctx, g_test_username, FREEBUSY_TEST_FID,
+						 FREEBUSY_TEST_START, FREEBUSY_TEST_END, &loaded, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+	ck_assert(!mapistore_freebusy_summary_exists(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID));
+
+	retval = mapistore_freebusy_summary_store(g_test_username, FREEBUSY_TEST_FID,
+						  FREEBUSY_TEST_START, FREEBUSY_TEST_END, events, 2);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(mapistore_freebusy_summary_exists(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID));
+	ck_assert(!mapistore_freebusy_summary_exists(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID_NONE));
+
+	count = _load(mem_ctx, &loaded);
+	ck_assert_int_eq(count, 2);
+	_assert_event_eq(&loaded[0], &events[0]);
+	_assert_event_eq(&loaded[1], &events[1]);
+
+	/* the summary is not valid for another range */
+	retval = mapistore_freebusy_summary_load(mem_ctx, g_test_username, FREEBUSY_TEST_FID,
+						 FREEBUSY_TEST_START + 1440, FREEBUSY_TEST_END + 1440, &loaded, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_summary_update) {
+	TALLOC_CTX			*mem_ctx;
+	struct mapistore_freebusy_event	events[2], event, *loaded;
+	enum mapistore_error		retval;
+	uint32_t			count;
+	uint64_t			mids[2] = { 0x10001, 0x30001 };
+
+	mem_ctx = talloc_new(NULL);
+	_make_event(&events[0], 0x10001, FREEBUSY_TEST_START + 60, FREEBUSY_TEST_START + 120, olBusy);
+	_make_event(&events[1], 0x20001, FREEBUSY_TEST_START + 600, FREEBUSY_TEST_START + 660, olTentative);
+	retval = mapistore_freebusy_summary_store(g_test_username, FREEBUSY_TEST_FID,
+						  FREEBUSY_TEST_START, FREEBUSY_TEST_END, events, 2);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	/* modified appointment replaces its previous version */
+	_make_event(&event, 0x20001, FREEBUSY_TEST_START + 900, FREEBUSY_TEST_START + 960, olOutOfOffice);
+	retval = mapistore_freebusy_summary_update_event(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID, &event);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	count = _load(mem_ctx, &loaded);
+	ck_assert_int_eq(count, 2);
+	_assert_event_eq(&loaded[1], &event);
+
+	/* new appointment outside of the range is not recorded */
+	_make_event(&event, 0x30001, FREEBUSY_TEST_END + 60, FREEBUSY_TEST_END + 120, olBusy);
+	retval = mapistore_freebusy_summary_update_event(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID, &event);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	count = _load(mem_ctx, &loaded);
+	ck_assert_int_eq(count, 2);
+
+	/* deleted appointments are removed, unknown ones are ignored */
+	retval = mapistore_freebusy_summary_delete_events(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID, 2, mids);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	count = _load(mem_ctx, &loaded);
+	ck_assert_int_eq(count, 1);
+	ck_assert(loaded[0].mid == 0x20001);
+
+	/* folders without summary are left untouched */
+	retval = mapistore_freebusy_summary_update_event(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID_NONE, &events[0]);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(!mapistore_freebusy_summary_exists(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID_NONE));
+
+	retval = mapistore_freebusy_summary_invalidate(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(!mapistore_freebusy_summary_exists(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID));
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_summary_disabled) {
+	struct mapistore_freebusy_event	events[1], *loaded;
+	enum mapistore_error		retval;
+	uint32_t			count;
+
+	_make_event(&events[0], 0x10001, FREEBUSY_TEST_START + 60, FREEBUSY_TEST_START + 120, olBusy);
+	retval = mapistore_freebusy_summary_store(g_test_username, FREEBUSY_TEST_FID,
+						  FREEBUSY_TEST_START, FREEBUSY_TEST_END, events, 1);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	mapistore_set_freebusy_summary_max_age(0);
+	ck_assert(!mapistore_freebusy_summary_exists(g_mstore_ctx, g_test_username, FREEBUSY_TEST_FID));
+	retval = mapistore_freebusy_summary_load(NULL, g_test_username, FREEBUSY_TEST_FID,
+						 FREEBUSY_TEST_START, FREEBUSY_TEST_END, &loaded, &count);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+} END_TEST
+
+
+static void tdb_setup(void)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_set_mapping_path("/tmp/");
+	ck_assert(retval == MAPISTORE_SUCCESS);
+	mapistore_set_freebusy_summary_max_age(MAPISTORE_FREEBUSY_SUMMARY_MAX_AGE);
+
+	/* the summary functions only check the context is initialized */
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+	g_mstore_ctx->processing_ctx = talloc_zero(g_mstore_ctx, struct processing_context);
+	g_mstore_ctx->context_list = talloc_zero(g_mstore_ctx, struct backend_context_list);
+}
+
+static void tdb_teardown(void)
+{
+	char *freebusy_file = NULL;
+
+	freebusy_file = talloc_asprintf(g_mstore_ctx, "%s%s/%s",
+					mapistore_get_mapping_path(),
+					g_test_username,
+					MAPISTORE_DB_FREEBUSY);
+	unlink(freebusy_file);
+	talloc_free(g_mstore_ctx);
+}
+
+Suite *mapistore_freebusy_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore free/busy summary");
+
+	tc = tcase_create("free/busy summary: TDB storage");
+	tcase_add_checked_fixture(tc, tdb_setup, tdb_teardown);
+	tcase_add_test(tc, test_summary_store_load);
+	tcase_add_test(tc, test_summary_update);
+	tcase_add_test(tc, test_summary_disabled);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -156,6 +156,52 @@ START_TEST(test_mysql_search_existing_fmid_invalid_input) {
 } END_TEST
 
 
+/* memcached records */
+
+START_TEST(test_memcached_record_keys) {
+	const uint8_t	uri_key[] = {
+		'U', 0xba, 0x96, 0x11, 0xaf, 0xf3, 0x21, 0xc5, 0x92
+	};
+	const uint8_t	fmid_key[] = {
+		'F', 0x06, 0x17, 0x3c, 0x79, 0x3a, 0x34, 0x2c, 0x43,
+		0xee, 0xee, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+	};
+	char		key[INDEXING_MEMCACHED_FMID_KEY_LEN];
+	char		other[INDEXING_MEMCACHED_FMID_KEY_LEN];
+
+	/* Records are shared by every host and outlive the processes
+	 * which wrote them: their layout must not change */
+	ck_assert_int_eq(sizeof (uri_key), INDEXING_MEMCACHED_URI_KEY_LEN);
+	_memcached_uri_key(key, INDEXING_EXIST_URL);
+	ck_assert(memcmp(key, uri_key, sizeof (uri_key)) == 0);
+
+	ck_assert_int_eq(sizeof (fmid_key), INDEXING_MEMCACHED_FMID_KEY_LEN);
+	_memcached_fmid_key(key, g_test_username, INDEXING_EXIST_FMID);
+	ck_assert(memcmp(key, fmid_key, sizeof (fmid_key)) == 0);
+
+	/* Users and FMIDs get keys of their own */
+	_memcached_fmid_key(other, "otheruser", INDEXING_EXIST_FMID);
+	ck_assert(memcmp(key, other, INDEXING_MEMCACHED_FMID_KEY_LEN) != 0);
+	_memcached_fmid_key(other, g_test_username, INDEXING_TEST_FMID);
+	ck_assert(memcmp(key, other, INDEXING_MEMCACHED_FMID_KEY_LEN) != 0);
+	_memcached_uri_key(other, INDEXING_TEST_URI);
+	ck_assert(memcmp(key, other, INDEXING_MEMCACHED_URI_KEY_LEN) != 0);
+} END_TEST
+
+START_TEST(test_memcached_record_values) {
+	const uint8_t	expected[] = { 0x08, 0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x81 };
+	char		value[8];
+
+	/* FMIDs are stored little-endian, whatever the host */
+	_memcached_put_uint64(value, 0x8102030405060708ULL);
+	ck_assert(memcmp(value, expected, sizeof (expected)) == 0);
+	ck_assert(_memcached_get_uint64(value) == 0x8102030405060708ULL);
+
+	_memcached_put_uint64(value, INDEXING_TEST_FMID);
+	ck_assert(_memcached_get_uint64(value) == INDEXING_TEST_FMID);
+} END_TEST
+
+
 /* add_fmid */
 
 START_TEST(test_add_fmid_sanity) {
@@ -456,6 +502,127 @@ START_TEST(test_get_fmid_with_wildcard) {
 } END_TEST
 
 
+START_TEST(test_get_fmid_with_wildcard_subfolder) {
+	enum mapistore_error	ret;
+	uint64_t		fid_1, fid_2;
+	uint64_t		fmid_res;
+	bool			soft_deleted = true;
+
+	fid_1 = INDEXING_TEST_FMID;
+	fid_2 = fid_1 + 1;
+	ret = g_ictx->add_fmid(g_ictx, g_test_username, fid_1, "foo://bar/folder1/");
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->add_fmid(g_ictx, g_test_username, fid_2, "foo://bar/folder1/sub/m1.eml");
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, "foo://bar/folder1/", false, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmid_res, fid_1);
+
+	/* prefix matches records several levels below */
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, "foo://bar/folder1/s*.eml", true, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(!soft_deleted);
+	ck_assert_int_eq(fmid_res, fid_2);
+
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, "*/m1.eml", true, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmid_res, fid_2);
+
+	/* updated URIs are no longer reachable through the old one */
+	ret = g_ictx->update_fmid(g_ictx, g_test_username, fid_2, "foo://bar/folder2/m1.eml");
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, "foo://bar/folder1/sub/m1.eml", false, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_NOT_FOUND);
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, "foo://bar/folder2/*", true, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmid_res, fid_2);
+
+	/* permanently deleted records are not found anymore */
+	ret = g_ictx->del_fmid(g_ictx, g_test_username, fid_2, MAPISTORE_PERMANENT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, "foo://bar/folder2/*", true, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_NOT_FOUND);
+} END_TEST
+
+
+/* batch operations */
+
+START_TEST(test_batch_fmids) {
+	enum mapistore_error	ret;
+	uint64_t		fmids[3];
+	const char		*uris[3] = { "foo://bar/b1", "foo://bar/b2", "foo://bar/b3" };
+	uint64_t		lookup[3];
+	char			*uris_res[3];
+	bool			soft_deleted[3];
+
+	fmids[0] = INDEXING_TEST_FMID;
+	fmids[1] = fmids[0] + 1;
+	fmids[2] = fmids[0] + 2;
+	ret = g_ictx->add_fmids(g_ictx, g_test_username, 3, fmids, uris);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	/* Adding an existing fmid fails and records nothing */
+	lookup[0] = fmids[2] + 1;
+	lookup[1] = INDEXING_EXIST_FMID;
+	ret = g_ictx->add_fmids(g_ictx, g_test_username, 2, lookup, uris);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_EXIST);
+
+	lookup[0] = fmids[1];
+	lookup[1] = fmids[2] + 1;
+	lookup[2] = INDEXING_EXIST_FMID;
+	ret = g_ictx->get_uris(g_ictx, g_test_username, g_ictx, 3, lookup, uris_res, soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_str_eq(uris_res[0], uris[1]);
+	ck_assert(!soft_deleted[0]);
+	ck_assert(uris_res[1] == NULL);
+	ck_assert_str_eq(uris_res[2], INDEXING_EXIST_URL);
+
+	ret = g_ictx->del_fmids(g_ictx, g_test_username, 2, fmids, MAPISTORE_SOFT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uris(g_ictx, g_test_username, g_ictx, 3, fmids, uris_res, soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_str_eq(uris_res[0], uris[0]);
+	ck_assert(soft_deleted[0]);
+	ck_assert(soft_deleted[1]);
+	ck_assert(!soft_deleted[2]);
+
+	ret = g_ictx->del_fmids(g_ictx, g_test_username, 3, fmids, MAPISTORE_PERMANENT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uris(g_ictx, g_test_username, g_ictx, 3, fmids, uris_res, soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(uris_res[0] == NULL);
+	ck_assert(uris_res[1] == NULL);
+	ck_assert(uris_res[2] == NULL);
+} END_TEST
+
+START_TEST(test_batch_del_fmids_invalid_fmid) {
+	enum mapistore_error	ret;
+	uint64_t		fmids[4];
+	const char		*uris[2] = { "foo://bar/b1", "foo://bar/b2" };
+	char			*uris_res[4];
+	bool			soft_deleted[4];
+
+	fmids[0] = INDEXING_TEST_FMID;
+	fmids[1] = fmids[0] + 1;
+	ret = g_ictx->add_fmids(g_ictx, g_test_username, 2, fmids, uris);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	/* An invalid and an unknown fmid do not stop the others */
+	fmids[2] = fmids[1];
+	fmids[1] = 0;
+	fmids[3] = fmids[2] + 1;
+	ret = g_ictx->del_fmids(g_ictx, g_test_username, 4, fmids, MAPISTORE_PERMANENT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	fmids[1] = fmids[2];
+	ret = g_ictx->get_uris(g_ictx, g_test_username, g_ictx, 2, fmids, uris_res, soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(uris_res[0] == NULL);
+	ck_assert(uris_res[1] == NULL);
+} END_TEST
+
+
 /* allocate_fmid */
 
 START_TEST (test_allocate_fmid) {
@@ -472,6 +639,196 @@ START_TEST (test_allocate_fmid) {
 	ck_assert(fmid1 != fmid2);
 } END_TEST
 
+/* fmid leases */
+
+START_TEST (test_fmid_lease) {
+	enum mapistore_error	ret;
+	uint64_t		fmid1 = 0;
+	uint64_t		fmid2 = 0;
+	uint64_t		range = 0;
+	uint64_t		range2 = 0;
+
+	/* Single fmids come from the same lease */
+	ret = g_ictx->allocate_fmid(g_ictx, g_test_username, &fmid1);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->allocate_fmid(g_ictx, g_test_username, &fmid2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(fmid2 == fmid1 + 1);
+
+	/* Large ranges are allocated after it by the backend */
+	ret = g_ictx->allocate_fmids(g_ictx, g_test_username, 8, &range);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(range == fmid1 + 16);
+
+	/* The last range can be given back, and only the last one */
+	ret = g_ictx->release_fmids(g_ictx, g_test_username, fmid1, 16);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_EXIST);
+	ret = g_ictx->release_fmids(g_ictx, g_test_username, range, 8);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->allocate_fmids(g_ictx, g_test_username, 8, &range2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(range2 == range);
+} END_TEST
+
+START_TEST (test_fmid_lease_release_after_other_context) {
+	enum mapistore_error	ret;
+	struct indexing_context	*ictx2 = NULL;
+	uint64_t		fmid1 = 0;
+	uint64_t		fmid2 = 0;
+	uint64_t		range = 0;
+
+	/* Another process allocating from the same database */
+	ret = mapistore_indexing_tdb_init(g_mstore_ctx, g_test_username, &ictx2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = mapistore_indexing_lease_init(ictx2, 16);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	ret = g_ictx->allocate_fmid(g_ictx, g_test_username, &fmid1);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = ictx2->allocate_fmid(ictx2, g_test_username, &fmid2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(fmid2 == fmid1 + 16);
+
+	/* The tail of the first lease is not given back: the counter
+	   no longer ends at it */
+	TALLOC_FREE(g_ictx->lease);
+	ret = ictx2->allocate_fmids(ictx2, g_test_username, 8, &range);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(range == fmid2 + 16);
+
+	/* The tail of the last lease is given back once the range
+	   allocated after it is */
+	ret = ictx2->release_fmids(ictx2, g_test_username, range, 8);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	talloc_free(ictx2);
+	ret = g_ictx->allocate_fmids(g_ictx, g_test_username, 8, &range);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(range == fmid2 + 1);
+} END_TEST
+
+/* in-process cache */
+
+START_TEST (test_lru_cache) {
+	enum mapistore_error	ret;
+	uint64_t		hits = 0, misses = 0;
+	uint64_t		fmid_res;
+	char			*uri = NULL;
+	bool			soft_deleted = true;
+
+	/* add_fmid populates the cache */
+	ret = g_ictx->add_fmid(g_ictx, g_test_username, INDEXING_TEST_FMID, INDEXING_TEST_URI);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_str_eq(uri, INDEXING_TEST_URI);
+	ck_assert(!soft_deleted);
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, INDEXING_TEST_URI, false, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(fmid_res == INDEXING_TEST_FMID);
+
+	ret = mapistore_indexing_lru_stats(g_ictx, &hits, &misses);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(hits == 2);
+
+	/* update invalidates the previous URI */
+	ret = g_ictx->update_fmid(g_ictx, g_test_username, INDEXING_TEST_FMID, INDEXING_TEST_URI_2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_str_eq(uri, INDEXING_TEST_URI_2);
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, INDEXING_TEST_URI, false, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_NOT_FOUND);
+
+	/* soft delete is reflected by the next lookup */
+	ret = g_ictx->del_fmid(g_ictx, g_test_username, INDEXING_TEST_FMID, MAPISTORE_SOFT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(soft_deleted);
+
+	/* permanent delete drops the record */
+	ret = g_ictx->del_fmid(g_ictx, g_test_username, INDEXING_TEST_FMID, MAPISTORE_PERMANENT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_lru_cache_other_context) {
+	enum mapistore_error	ret;
+	struct indexing_context	*ictx2 = NULL;
+	uint64_t		hits = 0, misses = 0;
+	uint64_t		fmid_res;
+	char			*uri = NULL;
+	bool			soft_deleted = true;
+
+	ret = g_ictx->add_fmid(g_ictx, g_test_username, INDEXING_TEST_FMID, INDEXING_TEST_URI);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = mapistore_indexing_lru_stats(g_ictx, &hits, &misses);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(hits == 1);
+
+	/* Another process renames the record behind the cache */
+	ret = mapistore_indexing_tdb_init(g_mstore_ctx, g_test_username, &ictx2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = ictx2->update_fmid(ictx2, g_test_username, INDEXING_TEST_FMID, INDEXING_TEST_URI_2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_str_eq(uri, INDEXING_TEST_URI_2);
+	ret = g_ictx->get_fmid(g_ictx, g_test_username, INDEXING_TEST_URI, false, &fmid_res, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_NOT_FOUND);
+
+	/* And then deletes it */
+	ret = ictx2->del_fmid(ictx2, g_test_username, INDEXING_TEST_FMID, MAPISTORE_PERMANENT_DELETE);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = g_ictx->get_uri(g_ictx, g_test_username, g_ictx, INDEXING_TEST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_ERR_NOT_FOUND);
+
+	ret = mapistore_indexing_lru_stats(g_ictx, &hits, &misses);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(hits == 1);
+
+	talloc_free(ictx2);
+} END_TEST
+
+START_TEST (test_lru_cache_ttl) {
+	enum mapistore_error	ret;
+	struct indexing_context	*ictx2 = NULL;
+	uint64_t		hits = 0, misses = 0;
+	char			*uri = NULL;
+	bool			soft_deleted = true;
+
+	ret = mapistore_indexing_tdb_init(g_mstore_ctx, g_test_username, &ictx2);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	/* Records of a backend without change counter only expire */
+	ictx2->get_generation = NULL;
+	mapistore_set_default_indexing_lru_ttl(1);
+	ret = mapistore_indexing_lru_init(ictx2, 16);
+	mapistore_set_default_indexing_lru_ttl(MAPISTORE_INDEXING_LRU_TTL);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+
+	ret = ictx2->get_uri(ictx2, g_test_username, ictx2, INDEXING_EXIST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = ictx2->get_uri(ictx2, g_test_username, ictx2, INDEXING_EXIST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ret = mapistore_indexing_lru_stats(ictx2, &hits, &misses);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(hits == 1 && misses == 1);
+
+	sleep(2);
+	ret = ictx2->get_uri(ictx2, g_test_username, ictx2, INDEXING_EXIST_FMID, &uri, &soft_deleted);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert_str_eq(uri, INDEXING_EXIST_URL);
+	ret = mapistore_indexing_lru_stats(ictx2, &hits, &misses);
+	ck_assert_int_eq(ret, MAPISTORE_SUCCESS);
+	ck_assert(hits == 1 && misses == 2);
+
+	talloc_free(ictx2);
+} END_TEST
+
 // ^ unit tests ---------------------------------------------------------------
 
 // v suite definition ---------------------------------------------------------
@@ -535,6 +892,24 @@ static void tdb_teardown(void)
 	talloc_free(g_mstore_ctx);
 }
 
+static void tdb_lru_setup(void)
+{
+	enum mapistore_error	retval;
+
+	tdb_setup();
+	retval = mapistore_indexing_lru_init(g_ictx, 16);
+	ck_assert(retval == MAPISTORE_SUCCESS);
+}
+
+static void tdb_lease_setup(void)
+{
+	enum mapistore_error	retval;
+
+	tdb_setup();
+	retval = mapistore_indexing_lease_init(g_ictx, 16);
+	ck_assert(retval == MAPISTORE_SUCCESS);
+}
+
 static TCase *create_test_case_indexing_interface(const char *name, SFun setup,
 						  SFun teardown)
 {
@@ -564,6 +939,9 @@ static TCase *create_test_case_indexing_interface(const char *name, SFun setup,
 	tcase_add_test(tc_interface, test_get_fmid_sanity);
 	tcase_add_test(tc_interface, test_get_fmid);
 	tcase_add_test(tc_interface, test_get_fmid_with_wildcard);
+	tcase_add_test(tc_interface, test_get_fmid_with_wildcard_subfolder);
+	tcase_add_test(tc_interface, test_batch_fmids);
+	tcase_add_test(tc_interface, test_batch_del_fmids_invalid_fmid);
 	tcase_add_test(tc_interface, test_allocate_fmid);
 
 	return tc_interface;
@@ -573,6 +951,7 @@ Suite *mapistore_indexing_mysql_suite(void)
 {
 	Suite *s;
 	TCase *tc_config;
+	TCase *tc_records;
 	TCase *tc_internal;
 	TCase *tc_interface;
 
@@ -583,6 +962,12 @@ Suite *mapistore_indexing_mysql_suite(void)
 	tcase_add_test(tc_config, test_backend_init_parameters);
 	suite_add_tcase(s, tc_config);
 
+	/* memcached records, which need no server */
+	tc_records = tcase_create("indexing: MySQL backend cache records");
+	tcase_add_test(tc_records, test_memcached_record_keys);
+	tcase_add_test(tc_records, test_memcached_record_values);
+	suite_add_tcase(s, tc_records);
+
 	/* test indexing backend internals */
 	tc_internal = tcase_create("indexing: MySQL backend internal");
 	tcase_add_checked_fixture(tc_internal, mysql_setup, mysql_teardown);
@@ -605,5 +990,16 @@ Suite *mapistore_indexing_tdb_suite(void)
 	tc_interface = create_test_case_indexing_interface("TDB", tdb_setup, tdb_teardown);
 	suite_add_tcase(s, tc_interface);
 
+	tc_interface = create_test_case_indexing_interface("TDB with LRU cache", tdb_lru_setup, tdb_teardown);
+	tcase_add_test(tc_interface, test_lru_cache);
+	tcase_add_test(tc_interface, test_lru_cache_other_context);
+	tcase_add_test(tc_interface, test_lru_cache_ttl);
+	suite_add_tcase(s, tc_interface);
+
+	tc_interface = create_test_case_indexing_interface("TDB with fmid lease", tdb_lease_setup, tdb_teardown);
+	tcase_add_test(tc_interface, test_fmid_lease);
+	tcase_add_test(tc_interface, test_fmid_lease_release_after_other_context);
+	suite_add_tcase(s, tc_interface);
+
 	return s;
 }
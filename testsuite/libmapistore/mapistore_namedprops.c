@@ -61,6 +61,204 @@ START_TEST (test_init) {
 
 } END_TEST
 
+/* Backend stub counting how many lookups reach the database */
+static int	backend_lookups;
+
+static enum mapistore_error stub_get_mapped_id(struct namedprops_context *nprops,
+					       struct MAPINAMEID nameid,
+					       uint16_t *mapped_id)
+{
+	backend_lookups++;
+	if (nameid.ulKind != MNID_ID || nameid.kind.lid != 0x8005) {
+		return MAPISTORE_ERR_NOT_FOUND;
+	}
+	*mapped_id = 0x8101;
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error stub_get_nameid(struct namedprops_context *nprops,
+					    uint16_t mapped_id,
+					    TALLOC_CTX *mem_ctx,
+					    struct MAPINAMEID **nameidp)
+{
+	backend_lookups++;
+	return MAPISTORE_ERR_NOT_FOUND;
+}
+
+START_TEST (test_cache) {
+	TALLOC_CTX			*mem_ctx;
+	struct namedprops_context	*nprops1;
+	struct namedprops_context	*nprops2;
+	struct MAPINAMEID		nameid;
+	struct MAPINAMEID		*result;
+	uint16_t			mapped_id;
+
+	mem_ctx = talloc_named(NULL, 0, "test_cache");
+	nprops1 = talloc_zero(mem_ctx, struct namedprops_context);
+	nprops1->get_mapped_id = stub_get_mapped_id;
+	nprops1->get_nameid = stub_get_nameid;
+	nprops2 = talloc_zero(mem_ctx, struct namedprops_context);
+	nprops2->get_mapped_id = stub_get_mapped_id;
+	nprops2->get_nameid = stub_get_nameid;
+
+	ck_assert_int_eq(mapistore_namedprops_cache_attach(nprops1, "stub://test_cache"), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_namedprops_cache_attach(nprops2, "stub://test_cache"), MAPISTORE_SUCCESS);
+	ck_assert(nprops1->cache == nprops2->cache);
+
+	memset(&nameid, 0, sizeof (nameid));
+	nameid.ulKind = MNID_ID;
+	GUID_from_string(PSETID_Address, &nameid.lpguid);
+	nameid.kind.lid = 0x8005;
+
+	backend_lookups = 0;
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops1, nameid, &mapped_id), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_id, 0x8101);
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops2, nameid, &mapped_id), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_id, 0x8101);
+	ck_assert_int_eq(backend_lookups, 1);
+
+	/* The reverse mapping is filled at the same time */
+	ck_assert_int_eq(mapistore_namedprops_get_nameid(nprops2, 0x8101, mem_ctx, &result), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(result->ulKind, MNID_ID);
+	ck_assert_int_eq(result->kind.lid, 0x8005);
+	ck_assert_int_eq(backend_lookups, 1);
+
+	/* Missing mappings always reach the backend */
+	nameid.kind.lid = 0x8006;
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops1, nameid, &mapped_id), MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops1, nameid, &mapped_id), MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(mapistore_namedprops_get_nameid(nprops1, 0x8102, mem_ctx, &result), MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(backend_lookups, 4);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+static uint32_t	backend_batch_size;
+
+static enum mapistore_error stub_get_mapped_ids(struct namedprops_context *nprops,
+						uint32_t count,
+						struct MAPINAMEID *nameids,
+						uint16_t *mapped_ids)
+{
+	uint32_t	i;
+
+	backend_lookups++;
+	backend_batch_size = count;
+	for (i = 0; i < count; i++) {
+		mapped_ids[i] = (nameids[i].kind.lid < 0x8010) ? nameids[i].kind.lid + 0x100 : 0;
+	}
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error stub_create_ids(struct namedprops_context *nprops,
+					    uint32_t count,
+					    struct MAPINAMEID *nameids,
+					    const uint16_t *mapped_ids)
+{
+	backend_lookups++;
+	backend_batch_size = count;
+	return MAPISTORE_SUCCESS;
+}
+
+START_TEST (test_batch) {
+	TALLOC_CTX			*mem_ctx;
+	struct namedprops_context	*nprops;
+	struct MAPINAMEID		nameids[4];
+	uint16_t			mapped_ids[4];
+	uint16_t			new_ids[2] = { 0x9000, 0x9001 };
+	uint16_t			mapped_id;
+	int				i;
+
+	mem_ctx = talloc_named(NULL, 0, "test_batch");
+	nprops = talloc_zero(mem_ctx, struct namedprops_context);
+	nprops->get_mapped_id = stub_get_mapped_id;
+	nprops->get_mapped_ids = stub_get_mapped_ids;
+	nprops->create_ids = stub_create_ids;
+	ck_assert_int_eq(mapistore_namedprops_cache_attach(nprops, "stub://test_batch"), MAPISTORE_SUCCESS);
+
+	memset(nameids, 0, sizeof (nameids));
+	for (i = 0; i < 4; i++) {
+		nameids[i].ulKind = MNID_ID;
+		GUID_from_string(PSETID_Address, &nameids[i].lpguid);
+	}
+	nameids[0].kind.lid = 0x8001;
+	nameids[1].kind.lid = 0x8020;
+	nameids[2].kind.lid = 0x8002;
+	nameids[3].kind.lid = 0x8021;
+
+	/* One backend lookup for the whole request */
+	backend_lookups = 0;
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_ids(nprops, 4, nameids, mapped_ids), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(backend_lookups, 1);
+	ck_assert_int_eq(mapped_ids[0], 0x8101);
+	ck_assert_int_eq(mapped_ids[1], 0);
+	ck_assert_int_eq(mapped_ids[2], 0x8102);
+	ck_assert_int_eq(mapped_ids[3], 0);
+
+	/* Only the names missing from the cache reach the backend */
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_ids(nprops, 4, nameids, mapped_ids), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(backend_lookups, 2);
+	ck_assert_int_eq(backend_batch_size, 2);
+
+	/* Created mappings are cached */
+	ck_assert_int_eq(mapistore_namedprops_create_ids(nprops, 2, &nameids[1], new_ids), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(backend_lookups, 3);
+	ck_assert_int_eq(backend_batch_size, 2);
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_ids(nprops, 4, nameids, mapped_ids), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(backend_lookups, 3);
+	ck_assert_int_eq(mapped_ids[1], 0x9000);
+	ck_assert_int_eq(mapped_ids[2], 0x8102);
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops, nameids[3], &mapped_id), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_id, 0x9001);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST (test_defaults) {
+	TALLOC_CTX			*mem_ctx;
+	struct namedprops_context	*nprops;
+	struct MAPINAMEID		nameid;
+	struct MAPINAMEID		*result;
+	uint16_t			mapped_id;
+	uint16_t			prop_type;
+
+	mem_ctx = talloc_named(NULL, 0, "test_defaults");
+	nprops = talloc_zero(mem_ctx, struct namedprops_context);
+	nprops->get_mapped_id = stub_get_mapped_id;
+	nprops->get_nameid = stub_get_nameid;
+	nprops->defaults = true;
+
+	/* PidLidPercentComplete, as provisioned */
+	memset(&nameid, 0, sizeof (nameid));
+	nameid.ulKind = MNID_ID;
+	GUID_from_string(PSETID_Task, &nameid.lpguid);
+	nameid.kind.lid = 0x8102;
+
+	backend_lookups = 0;
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops, nameid, &mapped_id), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_id, 37153);
+	ck_assert_int_eq(mapistore_namedprops_get_nameid(nprops, 37153, mem_ctx, &result), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(result->ulKind, MNID_ID);
+	ck_assert_int_eq(result->kind.lid, 0x8102);
+	ck_assert_int_eq(mapistore_namedprops_get_nameid_type(nprops, 37153, &prop_type), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(prop_type, PT_DOUBLE);
+
+	/* String names are matched like the backends do */
+	nameid.ulKind = MNID_STRING;
+	GUID_from_string(PS_PUBLIC_STRINGS, &nameid.lpguid);
+	nameid.kind.lpwstr.Name = "HTTP://schemas.microsoft.com/exchange/smallicon";
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops, nameid, &mapped_id), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_id, 38342);
+	ck_assert_int_eq(backend_lookups, 0);
+
+	/* Names created by clients are still looked up */
+	nameid.kind.lpwstr.Name = "http://schemas.example.com/custom";
+	ck_assert_int_eq(mapistore_namedprops_get_mapped_id(nprops, nameid, &mapped_id), MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(backend_lookups, 1);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
 Suite *mapistore_namedprops_suite(void)
 {
 	Suite	*s;
@@ -70,6 +268,9 @@ Suite *mapistore_namedprops_suite(void)
 
 	tc_intf = tcase_create("Interface");
 	tcase_add_test(tc_intf, test_init);
+	tcase_add_test(tc_intf, test_cache);
+	tcase_add_test(tc_intf, test_batch);
+	tcase_add_test(tc_intf, test_defaults);
 
 	suite_add_tcase(s, tc_intf);
 
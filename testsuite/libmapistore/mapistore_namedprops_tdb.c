@@ -251,6 +251,60 @@ START_TEST (test_create_id_MNID_STRING) {
 	talloc_free(mem_ctx);
 } END_TEST
 
+START_TEST (test_get_mapped_ids) {
+	struct MAPINAMEID	nameids[3];
+	uint16_t		mapped_ids[3];
+
+	memset(nameids, 0, sizeof (nameids));
+	nameids[0].ulKind = MNID_ID;
+	nameids[0].lpguid.time_low = 0x62003;
+	nameids[0].lpguid.clock_seq[0] = 0xc0;
+	nameids[0].lpguid.node[5] = 0x46;
+	nameids[0].kind.lid = 33026;
+	nameids[1].ulKind = MNID_STRING;
+	nameids[1].lpguid.time_low = 0x20329;
+	nameids[1].lpguid.clock_seq[0] = 0xc0;
+	nameids[1].lpguid.node[5] = 0x46;
+	nameids[1].kind.lpwstr.Name = "http://schemas.microsoft.com/exchange/smallicon";
+	nameids[2] = nameids[1];
+	nameids[2].kind.lpwstr.Name = "http://schemas.example.com/unmapped";
+
+	retval = get_mapped_ids(g_nprops, 3, nameids, mapped_ids);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_ids[0], 37153);
+	ck_assert_int_eq(mapped_ids[1], 38342);
+	ck_assert_int_eq(mapped_ids[2], 0);
+} END_TEST
+
+START_TEST (test_create_ids) {
+	struct MAPINAMEID	nameids[2];
+	uint16_t		new_ids[2] = { 43, 44 };
+	uint16_t		mapped_ids[2];
+
+	memset(nameids, 0, sizeof (nameids));
+	nameids[0].ulKind = MNID_ID;
+	nameids[0].kind.lid = 43;
+	nameids[1].ulKind = MNID_STRING;
+	nameids[1].kind.lpwstr.Name = "foobaz";
+
+	retval = create_ids(g_nprops, 2, nameids, new_ids);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	retval = get_mapped_ids(g_nprops, 2, nameids, mapped_ids);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_ids[0], 43);
+	ck_assert_int_eq(mapped_ids[1], 44);
+
+	/* A failing record leaves none of the batch behind */
+	nameids[0].kind.lid = 45;
+	new_ids[0] = 45;
+	retval = create_ids(g_nprops, 2, nameids, new_ids);
+	ck_assert_int_ne(retval, MAPISTORE_SUCCESS);
+	retval = get_mapped_ids(g_nprops, 1, nameids, mapped_ids);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapped_ids[0], 0);
+} END_TEST
+
 
 Suite *mapistore_namedprops_tdb_suite(void)
 {
@@ -272,6 +326,8 @@ Suite *mapistore_namedprops_tdb_suite(void)
 	tcase_add_test(tc_ldb_q, test_get_nameid_not_found);
 	tcase_add_test(tc_ldb_q, test_create_id_MNID_ID);
 	tcase_add_test(tc_ldb_q, test_create_id_MNID_STRING);
+	tcase_add_test(tc_ldb_q, test_get_mapped_ids);
+	tcase_add_test(tc_ldb_q, test_create_ids);
 
 	suite_add_tcase(s, tc_ldb_q);
 
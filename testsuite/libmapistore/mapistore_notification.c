@@ -23,6 +23,7 @@
 #include "mapiproxy/libmapistore/mapistore.h"
 #include "mapiproxy/libmapistore/mapistore_private.h"
 #include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_notification.h"
 #include "mapiproxy/libmapistore/gen_ndr/mapistore_notification.h"
 #include "mapiproxy/libmapistore/gen_ndr/ndr_mapistore_notification.h"
 
@@ -754,6 +755,97 @@ START_TEST(subscription_get) {
 
 } END_TEST
 
+START_TEST(subscription_find) {
+	TALLOC_CTX					*mem_ctx;
+	struct mapistore_context			mstore_ctx;
+	enum mapistore_error				retval;
+	struct loadparm_context				*lp_ctx;
+	struct mapistore_notification_context		*ctx = NULL;
+	struct mapistore_notification_subscription	r;
+	struct GUID					uuid;
+
+	/* Check sanity check compliance */
+	retval = mapistore_notification_subscription_find(NULL, NULL, gl_uuid, gl_flags_newmail, 0, &r);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_INITIALIZED);
+
+	retval = mapistore_notification_subscription_find(NULL, &mstore_ctx, gl_uuid, gl_flags_newmail, 0, NULL);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
+
+	mstore_ctx.notification_ctx = NULL;
+	retval = mapistore_notification_subscription_find(NULL, &mstore_ctx, gl_uuid, gl_flags_newmail, 0, &r);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	/* Initialize mapistore notification system */
+	mem_ctx = talloc_named(NULL, 0, "subscription_find");
+	ck_assert(mem_ctx != NULL);
+
+	lp_ctx = loadparm_init(mem_ctx);
+	ck_assert(lp_ctx != NULL);
+
+	retval = mapistore_notification_init(mem_ctx, lp_ctx, &ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	mstore_ctx.notification_ctx = ctx;
+
+	/* Subscriptions written by another process */
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, gl_uuid, gl_flags_newmail, 0, &r);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(r.v.v1.count, 1);
+	ck_assert_int_eq(r.v.v1.subscription[0].handle, gl_handle);
+
+	/* whole store table subscriptions match any folder */
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, gl_uuid, gl_flags_table, 0x1, &r);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(r.v.v1.count, 1);
+	ck_assert_int_eq(r.v.v1.subscription[0].handle, gl_handle + 2);
+	ck_assert_int_eq(r.v.v1.subscription[0].count, 2);
+	ck_assert_int_eq(r.v.v1.subscription[0].properties[1], gl_tags[1]);
+
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, gl_uuid,
+							  gl_flags_newmail|gl_flags_table, 0, &r);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(r.v.v1.count, 2);
+
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, gl_uuid, sub_SearchCompleted, 0, &r);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	/* Subscriptions written by this process */
+	uuid = GUID_random();
+	retval = mapistore_notification_subscription_add(&mstore_ctx, uuid, gl_handle, gl_flags_table,
+							 gl_FolderId, 0x0, 2, gl_tags);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	retval = mapistore_notification_subscription_add(&mstore_ctx, uuid, gl_handle + 1, gl_flags_newmail,
+							 gl_FolderId, 0x0, 0x0, NULL);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, uuid, gl_flags_table, 0x1, &r);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, uuid, gl_flags_table, gl_FolderId, &r);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(r.v.v1.count, 1);
+	ck_assert_int_eq(r.v.v1.subscription[0].handle, gl_handle);
+	ck_assert_int_eq(r.v.v1.subscription[0].properties[0], gl_tags[0]);
+
+	retval = mapistore_notification_subscription_get(mem_ctx, &mstore_ctx, uuid, &r);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(r.v.v1.count, 2);
+
+	/* Removed subscriptions are no longer found */
+	retval = mapistore_notification_subscription_delete_by_handle(&mstore_ctx, uuid, gl_handle);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, uuid, gl_flags_table, gl_FolderId, &r);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	retval = mapistore_notification_subscription_delete(&mstore_ctx, uuid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	retval = mapistore_notification_subscription_find(mem_ctx, &mstore_ctx, uuid, 0, 0, &r);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(lp_ctx);
+	talloc_free(mem_ctx);
+
+} END_TEST
+
 START_TEST(subscription_delete) {
 	TALLOC_CTX				*mem_ctx;
 	struct mapistore_context		mstore_ctx;
@@ -1111,10 +1203,147 @@ START_TEST(deliver_delete) {
 } END_TEST
 
 
+START_TEST(deliver_batch) {
+	TALLOC_CTX				*mem_ctx;
+	struct mapistore_context		mstore_ctx;
+	enum mapistore_error			retval;
+	struct loadparm_context			*lp_ctx;
+	struct mapistore_notification_context	*ctx = NULL;
+	struct mapistore_notification_batch	*batch = NULL;
+	DATA_BLOB				payload;
+
+	/* Check sanity check compliance */
+	retval = mapistore_notification_batch_init(NULL, NULL, &batch);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_INITIALIZED);
+
+	retval = mapistore_notification_batch_init(NULL, &mstore_ctx, NULL);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
+
+	retval = mapistore_notification_batch_deliver_add(NULL, gl_uuid, (uint8_t *) gl_deliver_1, 1);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_INITIALIZED);
+
+	retval = mapistore_notification_batch_commit(NULL);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_INITIALIZED);
+
+	/* Initialize mapistore notification system */
+	mem_ctx = talloc_named(NULL, 0, "deliver_batch");
+	ck_assert(mem_ctx != NULL);
+
+	lp_ctx = loadparm_init(mem_ctx);
+	ck_assert(lp_ctx != NULL);
+
+	retval = mapistore_notification_init(mem_ctx, lp_ctx, &ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	mstore_ctx.notification_ctx = ctx;
+
+	retval = mapistore_notification_batch_init(mem_ctx, &mstore_ctx, &batch);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	/* Nothing is written until the batch is committed */
+	retval = mapistore_notification_batch_deliver_add(batch, gl_uuid, (uint8_t *) gl_deliver_1,
+							  strlen(gl_deliver_1) + 1);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	retval = mapistore_notification_batch_deliver_add(batch, gl_uuid, (uint8_t *) gl_deliver_2,
+							  strlen(gl_deliver_2) + 1);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	retval = mapistore_notification_deliver_exist(&mstore_ctx, gl_uuid);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	retval = mapistore_notification_batch_commit(batch);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(batch->entries == NULL);
+
+	/* Payloads are delivered in order */
+	retval = mapistore_notification_deliver_get(mem_ctx, &mstore_ctx, gl_uuid,
+						    &payload.data, &payload.length);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(payload.length, strlen(gl_deliver_1) + strlen(gl_deliver_2) + 2);
+	ck_assert_str_eq((char *) payload.data, gl_deliver_1);
+	ck_assert_str_eq((char *)(payload.data + strlen(gl_deliver_1) + 1), gl_deliver_2);
+
+	retval = mapistore_notification_deliver_delete(&mstore_ctx, gl_uuid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	talloc_free(lp_ctx);
+	talloc_free(mem_ctx);
+} END_TEST
+
+
+START_TEST(deliver_bus) {
+	TALLOC_CTX				*mem_ctx;
+	struct mapistore_context		mstore_ctx;
+	enum mapistore_error			retval;
+	struct loadparm_context			*lp_ctx;
+	struct mapistore_notification_context	*ctx = NULL;
+	DATA_BLOB				payload;
+	bool					bret;
+
+	/* Check sanity check compliance */
+	memset(&mstore_ctx, 0, sizeof (struct mapistore_context));
+	retval = mapistore_notification_bus_publish(NULL, gl_uuid, (uint8_t *) gl_deliver_1, 1);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_INITIALIZED);
+
+	retval = mapistore_notification_bus_publish(&mstore_ctx, gl_uuid, (uint8_t *) gl_deliver_1, 1);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_AVAILABLE);
+
+	retval = mapistore_notification_bus_fetch(NULL, &mstore_ctx, gl_uuid, NULL, &payload.length);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
+
+	mem_ctx = talloc_named(NULL, 0, "deliver_bus");
+	ck_assert(mem_ctx != NULL);
+
+	lp_ctx = loadparm_init(mem_ctx);
+	ck_assert(lp_ctx != NULL);
+
+	/* memcached is the default bus */
+	retval = mapistore_notification_init(mem_ctx, lp_ctx, &ctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(ctx->bus != NULL);
+	ck_assert_str_eq(ctx->bus->ops->name, "memcached");
+	mstore_ctx.notification_ctx = ctx;
+
+	/* Subscriptions are not needed with records */
+	retval = mapistore_notification_bus_subscribe(&mstore_ctx, gl_uuid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	retval = mapistore_notification_bus_publish(&mstore_ctx, gl_uuid, (uint8_t *) gl_deliver_1,
+						    strlen(gl_deliver_1) + 1);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	retval = mapistore_notification_bus_publish(&mstore_ctx, gl_uuid, (uint8_t *) gl_deliver_2,
+						    strlen(gl_deliver_2) + 1);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	/* Fetching consumes the deliveries */
+	retval = mapistore_notification_bus_fetch(mem_ctx, &mstore_ctx, gl_uuid, &payload.data, &payload.length);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(payload.length, strlen(gl_deliver_1) + strlen(gl_deliver_2) + 2);
+	ck_assert_str_eq((char *) payload.data, gl_deliver_1);
+	ck_assert_str_eq((char *)(payload.data + strlen(gl_deliver_1) + 1), gl_deliver_2);
+
+	retval = mapistore_notification_bus_fetch(mem_ctx, &mstore_ctx, gl_uuid, &payload.data, &payload.length);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	retval = mapistore_notification_bus_unsubscribe(&mstore_ctx, gl_uuid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	/* Unknown buses are refused */
+	bret = lpcfg_set_cmdline(lp_ctx, "mapistore:notification_bus", "carrier-pigeon");
+	ck_assert(bret == true);
+	ctx = NULL;
+	retval = mapistore_notification_init(mem_ctx, lp_ctx, &ctx);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
+
+	talloc_free(lp_ctx);
+	talloc_free(mem_ctx);
+} END_TEST
+
+
 START_TEST(payload_newmail) {
 	enum mapistore_error		retval;
 	TALLOC_CTX			*mem_ctx;
 	DATA_BLOB			payload;
+	char				*cn = "user1";
 	char				*backend = "python://";
 	char				*eml = "123456.eml";
 	char				*folder = "";
@@ -1127,23 +1356,26 @@ START_TEST(payload_newmail) {
 	ck_assert(mem_ctx != NULL);
 
 	/* Check sanity check compliance */
-	retval = mapistore_notification_payload_newmail(mem_ctx, NULL, eml, NULL, separator, &payload.data, &payload.length);
+	retval = mapistore_notification_payload_newmail(mem_ctx, NULL, backend, eml, folder, separator, &payload.data, &payload.length);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
+
+	retval = mapistore_notification_payload_newmail(mem_ctx, cn, NULL, eml, NULL, separator, &payload.data, &payload.length);
 	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
 
-	retval = mapistore_notification_payload_newmail(mem_ctx, backend, NULL, folder, separator, &payload.data, &payload.length);
+	retval = mapistore_notification_payload_newmail(mem_ctx, cn, backend, NULL, folder, separator, &payload.data, &payload.length);
 	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
 
-	retval = mapistore_notification_payload_newmail(mem_ctx, backend, eml, folder, separator, NULL, &payload.length);
+	retval = mapistore_notification_payload_newmail(mem_ctx, cn, backend, eml, folder, separator, NULL, &payload.length);
 	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
 
-	retval = mapistore_notification_payload_newmail(mem_ctx, backend, eml, NULL, separator, &payload.data, &payload.length);
+	retval = mapistore_notification_payload_newmail(mem_ctx, cn, backend, eml, NULL, separator, &payload.data, &payload.length);
 	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
 
-	retval = mapistore_notification_payload_newmail(mem_ctx, backend, eml, folder, separator, &payload.data, NULL);
+	retval = mapistore_notification_payload_newmail(mem_ctx, cn, backend, eml, folder, separator, &payload.data, NULL);
 	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
 
 	/* Build newmail payload */
-	retval = mapistore_notification_payload_newmail(mem_ctx, backend, eml, folder, separator, &payload.data, &payload.length);
+	retval = mapistore_notification_payload_newmail(mem_ctx, cn, backend, eml, folder, separator, &payload.data, &payload.length);
 	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
 
 	ndr = ndr_pull_init_blob(&payload, mem_ctx);
@@ -1153,12 +1385,64 @@ START_TEST(payload_newmail) {
 	ndr_err_code = ndr_pull_mapistore_notification(ndr, NDR_SCALARS, &r);
 	ck_assert_int_eq(ndr_err_code, NDR_ERR_SUCCESS);
 
-	/* newmail v1 checks */
-	ck_assert_int_eq(r.vnum, 1);
+	/* newmail v2 checks */
+	ck_assert_int_eq(r.vnum, MAPISTORE_NOTIFICATION_V2);
+	ck_assert_str_eq(r.v.v2.cn, cn);
+	ck_assert_int_eq(r.v.v2.flags, sub_NewMail);
+	ck_assert_str_eq(r.v.v2.u.newmail.backend, backend);
+	ck_assert_str_eq(r.v.v2.u.newmail.eml, eml);
+	ck_assert_int_eq(r.v.v2.u.newmail.separator, separator);
+
+	talloc_free(mem_ctx);
+
+} END_TEST
+
+START_TEST(payload_newmail_v1) {
+	TALLOC_CTX			*mem_ctx;
+	DATA_BLOB			payload;
+	struct ndr_push			*push;
+	struct ndr_pull			*pull;
+	enum ndr_err_code		ndr_err_code;
+	struct mapistore_notification	r;
+	/* Wire format emitted by publishers which predate v2 */
+	const uint8_t			expected[] = { 0x01, 0x02, 0x00,
+						       'p', 'y', 0x00,
+						       '1', '.', 'e', 'm', 'l', 0x00,
+						       0x00, '.' };
+
+	mem_ctx = talloc_named(NULL, 0, "payload_newmail_v1");
+	ck_assert(mem_ctx != NULL);
+
+	r.vnum = MAPISTORE_NOTIFICATION_V1;
+	r.v.v1.flags = sub_NewMail;
+	r.v.v1.u.newmail.backend = "py";
+	r.v.v1.u.newmail.eml = "1.eml";
+	r.v.v1.u.newmail.folder = "";
+	r.v.v1.u.newmail.separator = '.';
+
+	push = ndr_push_init_ctx(mem_ctx);
+	ck_assert(push != NULL);
+	ndr_set_flags(&push->flags, LIBNDR_FLAG_NOALIGN);
+	ndr_err_code = ndr_push_mapistore_notification(push, NDR_SCALARS, &r);
+	ck_assert_int_eq(ndr_err_code, NDR_ERR_SUCCESS);
+	ck_assert_int_eq(push->offset, sizeof (expected));
+	ck_assert(memcmp(push->data, expected, sizeof (expected)) == 0);
+
+	/* v1 payloads still decode with the current interface */
+	payload.data = (uint8_t *) expected;
+	payload.length = sizeof (expected);
+	pull = ndr_pull_init_blob(&payload, mem_ctx);
+	ck_assert(pull != NULL);
+	ndr_set_flags(&pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+	memset(&r, 0, sizeof (r));
+	ndr_err_code = ndr_pull_mapistore_notification(pull, NDR_SCALARS, &r);
+	ck_assert_int_eq(ndr_err_code, NDR_ERR_SUCCESS);
+	ck_assert_int_eq(r.vnum, MAPISTORE_NOTIFICATION_V1);
 	ck_assert_int_eq(r.v.v1.flags, sub_NewMail);
-	ck_assert_str_eq(r.v.v1.u.newmail.backend, backend);
-	ck_assert_str_eq(r.v.v1.u.newmail.eml, eml);
-	ck_assert_int_eq(r.v.v1.u.newmail.separator, separator);
+	ck_assert_str_eq(r.v.v1.u.newmail.backend, "py");
+	ck_assert_str_eq(r.v.v1.u.newmail.eml, "1.eml");
+	ck_assert_str_eq(r.v.v1.u.newmail.folder, "");
+	ck_assert_int_eq(r.v.v1.u.newmail.separator, '.');
 
 	talloc_free(mem_ctx);
 
@@ -1205,6 +1489,7 @@ Suite *mapistore_notification_suite(void)
 	tcase_add_test(tc_subscription, subscription_add);
 	tcase_add_test(tc_subscription, subscription_exist);
 	tcase_add_test(tc_subscription, subscription_get);
+	tcase_add_test(tc_subscription, subscription_find);
 	tcase_add_test(tc_subscription, subscription_delete_by_handle);
 	tcase_add_test(tc_subscription, subscription_delete);
 	suite_add_tcase(s, tc_subscription);
@@ -1215,11 +1500,14 @@ Suite *mapistore_notification_suite(void)
 	tcase_add_test(tc_deliver, deliver_exist);
 	tcase_add_test(tc_deliver, deliver_get);
 	tcase_add_test(tc_deliver, deliver_delete);
+	tcase_add_test(tc_deliver, deliver_batch);
+	tcase_add_test(tc_deliver, deliver_bus);
 	suite_add_tcase(s, tc_deliver);
 
 	/* Payload */
 	tc_payload = tcase_create("notification payloads");
 	tcase_add_test(tc_payload, payload_newmail);
+	tcase_add_test(tc_payload, payload_newmail_v1);
 	suite_add_tcase(s, tc_payload);
 
 	return s;
@@ -0,0 +1,116 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+/* Global test variables */
+static struct mapistore_backend	g_backend;
+
+
+START_TEST(test_profile_disabled) {
+	struct mapistore_backend_op_stats	stats;
+	struct timespec				start;
+	enum mapistore_error			retval;
+
+	g_backend.backend.name = "profiletest-disabled";
+
+	mapistore_backend_profile_start(&start);
+	retval = mapistore_backend_profile_end(&g_backend, MAPISTORE_BACKEND_OP_TABLE_GET_ROW, NULL, &start, MAPISTORE_ERR_NOT_FOUND);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	retval = mapistore_backend_profile_get(g_backend.backend.name, MAPISTORE_BACKEND_OP_TABLE_GET_ROW, &stats);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+} END_TEST
+
+START_TEST(test_profile_counters) {
+	struct mapistore_backend_op_stats	stats;
+	struct timespec				start;
+	enum mapistore_error			retval;
+	uint64_t				total = 0;
+	uint32_t				i;
+
+	g_backend.backend.name = "profiletest-counters";
+	mapistore_set_backend_profiling(true, 0);
+
+	mapistore_backend_profile_start(&start);
+	retval = mapistore_backend_profile_end(&g_backend, MAPISTORE_BACKEND_OP_MESSAGE_SAVE, "fake://uri", &start, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	mapistore_backend_profile_start(&start);
+	retval = mapistore_backend_profile_end(&g_backend, MAPISTORE_BACKEND_OP_MESSAGE_SAVE, "fake://uri", &start, MAPISTORE_ERROR);
+	ck_assert_int_eq(retval, MAPISTORE_ERROR);
+
+	retval = mapistore_backend_profile_get(g_backend.backend.name, MAPISTORE_BACKEND_OP_MESSAGE_SAVE, &stats);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(stats.count == 2);
+	ck_assert(stats.errors == 1);
+	ck_assert(stats.max_usec <= stats.total_usec);
+	for (i = 0; i < MAPISTORE_BACKEND_PROFILE_BUCKETS; i++) {
+		total += stats.buckets[i];
+	}
+	ck_assert(total == 2);
+
+	/* other operations of the backend are left untouched */
+	retval = mapistore_backend_profile_get(g_backend.backend.name, MAPISTORE_BACKEND_OP_MESSAGE_SUBMIT, &stats);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(stats.count == 0);
+
+	retval = mapistore_backend_profile_get(g_backend.backend.name, MAPISTORE_BACKEND_OP_MAX, &stats);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_INVALID_PARAMETER);
+} END_TEST
+
+START_TEST(test_profile_op_name) {
+	ck_assert_str_eq(mapistore_backend_op_name(MAPISTORE_BACKEND_OP_TABLE_GET_ROW), "table.get_row");
+	ck_assert_str_eq(mapistore_backend_op_name(MAPISTORE_BACKEND_OP_FOLDER_DELETE_MESSAGES), "folder.delete_messages");
+	ck_assert_str_eq(mapistore_backend_op_name(MAPISTORE_BACKEND_OP_MANAGER_GENERATE_URI), "manager.generate_uri");
+	ck_assert_str_eq(mapistore_backend_op_name(MAPISTORE_BACKEND_OP_MAX), "unknown");
+} END_TEST
+
+
+static void profile_setup(void)
+{
+	memset(&g_backend, 0, sizeof (g_backend));
+	mapistore_set_backend_profiling(false, 0);
+}
+
+static void profile_teardown(void)
+{
+	mapistore_set_backend_profiling(false, 0);
+}
+
+Suite *mapistore_profile_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore backend profiler");
+
+	tc = tcase_create("backend profiler: counters");
+	tcase_add_checked_fixture(tc, profile_setup, profile_teardown);
+	tcase_add_test(tc, test_profile_disabled);
+	tcase_add_test(tc, test_profile_counters);
+	tcase_add_test(tc, test_profile_op_name);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
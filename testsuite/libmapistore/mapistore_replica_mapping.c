@@ -0,0 +1,149 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define REPLICA_TEST_GUID_1	"c4898b91-da9d-4f3e-9ae4-8a8bd5051b89"
+#define REPLICA_TEST_GUID_2	"f6a4c8a0-1b4a-4b4a-9e0d-5f9c8d2e1a37"
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+static const char		*g_test_username = "replicatestuser";
+
+
+START_TEST(test_guid_to_replid) {
+	struct GUID			guid1, guid2;
+	uint16_t			replid;
+	enum mapistore_error		retval;
+
+	ck_assert(NT_STATUS_IS_OK(GUID_from_string(REPLICA_TEST_GUID_1, &guid1)));
+	ck_assert(NT_STATUS_IS_OK(GUID_from_string(REPLICA_TEST_GUID_2, &guid2)));
+
+	/* replica ids are allocated from 0x3 */
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid1, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(replid, 0x3);
+
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid2, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(replid, 0x4);
+
+	/* known guids keep their replica id */
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid1, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(replid, 0x3);
+} END_TEST
+
+START_TEST(test_replid_to_guid) {
+	struct GUID			guid1, guid;
+	uint16_t			replid;
+	enum mapistore_error		retval;
+
+	ck_assert(NT_STATUS_IS_OK(GUID_from_string(REPLICA_TEST_GUID_1, &guid1)));
+
+	retval = mapistore_replica_mapping_replid_to_guid(g_mstore_ctx, g_test_username, 0x3, &guid);
+	ck_assert_int_eq(retval, MAPISTORE_ERROR);
+
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid1, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	retval = mapistore_replica_mapping_replid_to_guid(g_mstore_ctx, g_test_username, replid, &guid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(GUID_equal(&guid, &guid1));
+} END_TEST
+
+START_TEST(test_mapping_reload) {
+	struct GUID				guid1, guid2, guid;
+	uint16_t				replid;
+	enum mapistore_error			retval;
+	struct replica_mapping_context_list	*rmctx;
+
+	ck_assert(NT_STATUS_IS_OK(GUID_from_string(REPLICA_TEST_GUID_1, &guid1)));
+	ck_assert(NT_STATUS_IS_OK(GUID_from_string(REPLICA_TEST_GUID_2, &guid2)));
+
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid1, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid2, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+
+	/* a new session loads the stored mappings in memory */
+	talloc_free(g_mstore_ctx);
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+
+	retval = mapistore_replica_mapping_add(g_mstore_ctx, g_test_username, &rmctx);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(rmctx != NULL);
+	ck_assert_int_eq(rmctx->entries_count, 2);
+
+	retval = mapistore_replica_mapping_replid_to_guid(g_mstore_ctx, g_test_username, 0x4, &guid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert(GUID_equal(&guid, &guid2));
+
+	retval = mapistore_replica_mapping_guid_to_replid(g_mstore_ctx, g_test_username, &guid1, &replid);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(replid, 0x3);
+	ck_assert_int_eq(rmctx->entries_count, 2);
+} END_TEST
+
+
+static void tdb_setup(void)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_set_mapping_path("/tmp/");
+	ck_assert(retval == MAPISTORE_SUCCESS);
+	mapistore_set_default_replica_mapping_url(NULL);
+
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+}
+
+static void tdb_teardown(void)
+{
+	char *replica_mapping_file = NULL;
+
+	replica_mapping_file = talloc_asprintf(g_mstore_ctx, "%s%s/%s",
+					       mapistore_get_mapping_path(),
+					       g_test_username,
+					       MAPISTORE_DB_REPLICA_MAPPING);
+	unlink(replica_mapping_file);
+	talloc_free(g_mstore_ctx);
+}
+
+Suite *mapistore_replica_mapping_tdb_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore replica mapping: TDB backend");
+
+	tc = tcase_create("replica mapping: TDB backend interface");
+	tcase_add_checked_fixture(tc, tdb_setup, tdb_teardown);
+	tcase_add_test(tc, test_guid_to_replid);
+	tcase_add_test(tc, test_replid_to_guid);
+	tcase_add_test(tc, test_mapping_reload);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,177 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "testsuite_common.h"
+#include "mapiproxy/libmapistore/mapistore.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define TOMBSTONES_TEST_FID		0x0000000000210001ULL
+#define TOMBSTONES_TEST_FID_NONE	0x0000000000220001ULL
+
+#define	CN(x)	(((uint64_t)(x) << 16) | 0x0001)
+
+/* Global test variables */
+static struct mapistore_context	*g_mstore_ctx = NULL;
+static const char		*g_test_username = "tombstonestestuser";
+
+
+START_TEST(test_tombstones_range) {
+	TALLOC_CTX		*mem_ctx;
+	struct UI8Array_r	*fmids;
+	uint64_t		mids[2] = { 0x10001, 0x20001 };
+	uint64_t		mid = 0x30001;
+	uint64_t		cn;
+	enum mapistore_error	retval;
+
+	mem_ctx = talloc_new(NULL);
+
+	ck_assert_int_eq(mapistore_tombstones_add(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(10), 2, mids),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_tombstones_add(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(20), 1, &mid),
+			 MAPISTORE_SUCCESS);
+
+	/* Deletions after the client state, highest change number */
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(9), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmids->cValues, 3);
+	ck_assert(fmids->lpui8[0] == 0x10001);
+	ck_assert(fmids->lpui8[2] == 0x30001);
+	ck_assert(cn == CN(20));
+
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(15), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmids->cValues, 1);
+	ck_assert(fmids->lpui8[0] == 0x30001);
+
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(20), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmids->cValues, 0);
+	ck_assert(cn == CN(20));
+
+	/* Change numbers allocated earlier by another session are kept in order */
+	mid = 0x40001;
+	ck_assert_int_eq(mapistore_tombstones_add(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(15), 1, &mid),
+			 MAPISTORE_SUCCESS);
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(12), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmids->cValues, 2);
+	ck_assert(fmids->lpui8[0] == 0x40001);
+	ck_assert(fmids->lpui8[1] == 0x30001);
+
+	/* The log does not know what was deleted before it was created */
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(5), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID_NONE, CN(5), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+START_TEST(test_tombstones_compaction) {
+	TALLOC_CTX		*mem_ctx;
+	struct UI8Array_r	*fmids;
+	uint64_t		*mids;
+	uint64_t		mid, cn;
+	uint32_t		i;
+	enum mapistore_error	retval;
+
+	mem_ctx = talloc_new(NULL);
+
+	mids = talloc_array(mem_ctx, uint64_t, MAPISTORE_TOMBSTONES_MAX);
+	ck_assert(mids != NULL);
+	for (i = 0; i < MAPISTORE_TOMBSTONES_MAX; i++) {
+		mids[i] = ((uint64_t) (i + 1) << 16) | 0x0001;
+	}
+	ck_assert_int_eq(mapistore_tombstones_add(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(1), 2, mids),
+			 MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_tombstones_add(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(2),
+						  MAPISTORE_TOMBSTONES_MAX, mids),
+			 MAPISTORE_SUCCESS);
+
+	/* The two oldest deletions were dropped */
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(0), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(1), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_SUCCESS);
+	ck_assert_int_eq(fmids->cValues, MAPISTORE_TOMBSTONES_MAX);
+	ck_assert(cn == CN(2));
+
+	/* A dropped log is not answered anymore */
+	ck_assert_int_eq(mapistore_tombstones_folder_reset(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID),
+			 MAPISTORE_SUCCESS);
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(2), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	/* Nothing is logged nor answered when disabled */
+	mid = 0x10001;
+	mapistore_set_tombstones(false, 0);
+	ck_assert(!mapistore_tombstones_enabled());
+	ck_assert_int_eq(mapistore_tombstones_add(g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(100), 1, &mid),
+			 MAPISTORE_SUCCESS);
+	mapistore_set_tombstones(true, 0);
+	retval = mapistore_tombstones_get(mem_ctx, g_mstore_ctx, g_test_username, TOMBSTONES_TEST_FID, CN(99), &fmids, &cn);
+	ck_assert_int_eq(retval, MAPISTORE_ERR_NOT_FOUND);
+
+	talloc_free(mem_ctx);
+} END_TEST
+
+static void tdb_setup(void)
+{
+	enum mapistore_error	retval;
+
+	retval = mapistore_set_mapping_path("/tmp/");
+	ck_assert(retval == MAPISTORE_SUCCESS);
+	mapistore_set_tombstones(true, 0);
+
+	/* the tombstones functions only check the context is initialized */
+	g_mstore_ctx = talloc_zero(NULL, struct mapistore_context);
+	ck_assert(g_mstore_ctx != NULL);
+	g_mstore_ctx->processing_ctx = talloc_zero(g_mstore_ctx, struct processing_context);
+	g_mstore_ctx->context_list = talloc_zero(g_mstore_ctx, struct backend_context_list);
+}
+
+static void tdb_teardown(void)
+{
+	char *log_file = NULL;
+
+	log_file = talloc_asprintf(g_mstore_ctx, "%s%s/%s",
+				   mapistore_get_mapping_path(),
+				   g_test_username,
+				   MAPISTORE_DB_TOMBSTONES);
+	unlink(log_file);
+	talloc_free(g_mstore_ctx);
+}
+
+Suite *mapistore_tombstones_suite(void)
+{
+	Suite *s;
+	TCase *tc;
+
+	s = suite_create("libmapistore tombstones");
+
+	tc = tcase_create("tombstones: TDB storage");
+	tcase_add_checked_fixture(tc, tdb_setup, tdb_teardown);
+	tcase_add_test(tc, test_tombstones_range);
+	tcase_add_test(tc, test_tombstones_compaction);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,202 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/servers/default/nspi/dcesrv_exchange_nsp.h"
+
+#define	SNAPSHOT_LDB_PATH	"/tmp/emsabp_snapshot.ldb"
+#define	SNAPSHOT_BASEDN		"DC=example,DC=com"
+#define	SNAPSHOT_FILTER		"(objectClass=user)"
+
+/* Global test variables */
+static TALLOC_CTX		*mem_ctx;
+static struct emsabp_context	*emsabp_ctx;
+
+static const char * const users[] = { "alice", "bob", "carol", NULL };
+
+
+static const char *user_dn(const char *name)
+{
+	const char	*dn;
+
+	dn = talloc_asprintf(mem_ctx, "CN=%s,%s", name, SNAPSHOT_BASEDN);
+	ck_assert(dn != NULL);
+	return dn;
+}
+
+static void add_user(const char *name)
+{
+	struct ldb_message	*msg;
+
+	msg = ldb_msg_new(mem_ctx);
+	ck_assert(msg != NULL);
+	msg->dn = ldb_dn_new(msg, emsabp_ctx->samdb_ctx, user_dn(name));
+	ck_assert(msg->dn != NULL);
+	ck_assert_int_eq(ldb_msg_add_string(msg, "objectClass", "user"), LDB_SUCCESS);
+	ck_assert_int_eq(ldb_msg_add_string(msg, "displayName", name), LDB_SUCCESS);
+	ck_assert_int_eq(ldb_msg_add_string(msg, "mailNickName", name), LDB_SUCCESS);
+	ck_assert_int_eq(ldb_add(emsabp_ctx->samdb_ctx, msg), LDB_SUCCESS);
+	talloc_free(msg);
+}
+
+static void delete_user(const char *name)
+{
+	struct ldb_dn	*dn;
+
+	dn = ldb_dn_new(mem_ctx, emsabp_ctx->samdb_ctx, user_dn(name));
+	ck_assert(dn != NULL);
+	ck_assert_int_eq(ldb_delete(emsabp_ctx->samdb_ctx, dn), LDB_SUCCESS);
+	talloc_free(dn);
+}
+
+static struct emsabp_snapshot *get_snapshot(void)
+{
+	struct emsabp_snapshot	*snapshot = NULL;
+
+	ck_assert_int_eq(emsabp_snapshot_get(mem_ctx, emsabp_ctx, SNAPSHOT_FILTER, false, &snapshot),
+			 MAPI_E_SUCCESS);
+	ck_assert(snapshot != NULL);
+	return snapshot;
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_snapshot_shared) {
+	struct emsabp_snapshot	*snapshot;
+	struct ldb_message	*msg;
+
+	ck_assert(emsabp_snapshot_enabled(emsabp_ctx));
+
+	/* The directory did not change: the same snapshot is served */
+	snapshot = get_snapshot();
+	ck_assert(get_snapshot() == snapshot);
+	ck_assert_int_eq(snapshot->res->count, 3);
+
+	msg = emsabp_snapshot_find_dn(snapshot, user_dn("bob"));
+	ck_assert(msg != NULL);
+	ck_assert_str_eq(ldb_msg_find_attr_as_string(msg, "displayName", ""), "bob");
+	ck_assert(emsabp_snapshot_find_dn(snapshot, user_dn("dave")) == NULL);
+	ck_assert(emsabp_snapshot_lookup_dn(mem_ctx, user_dn("carol")) != NULL);
+} END_TEST
+
+START_TEST (test_snapshot_seq_num) {
+	struct emsabp_snapshot	*before;
+	struct emsabp_snapshot	*after;
+
+	before = get_snapshot();
+
+	/* An addition is visible right away, whatever the TTL */
+	add_user("dave");
+	after = get_snapshot();
+	ck_assert(after != before);
+	ck_assert(after->seq_num != before->seq_num);
+	ck_assert_int_eq(after->res->count, 4);
+	ck_assert(emsabp_snapshot_find_dn(after, user_dn("dave")) != NULL);
+	ck_assert(emsabp_snapshot_lookup_dn(mem_ctx, user_dn("dave")) != NULL);
+
+	/* The previous snapshot is left untouched for its users */
+	ck_assert_int_eq(before->res->count, 3);
+	ck_assert(emsabp_snapshot_find_dn(before, user_dn("dave")) == NULL);
+
+	/* So is a deletion, even though a stale snapshot still holds
+	 * the entry */
+	delete_user("alice");
+	before = after;
+	after = get_snapshot();
+	ck_assert(after != before);
+	ck_assert_int_eq(after->res->count, 3);
+	ck_assert(emsabp_snapshot_find_dn(before, user_dn("alice")) != NULL);
+	ck_assert(emsabp_snapshot_lookup_dn(mem_ctx, user_dn("alice")) == NULL);
+} END_TEST
+
+START_TEST (test_snapshot_disabled) {
+	struct emsabp_snapshot	*first;
+	struct emsabp_snapshot	*second;
+
+	ck_assert(lpcfg_set_cmdline(emsabp_ctx->lp_ctx, "exchange_nsp:snapshot_ttl", "0"));
+	ck_assert(!emsabp_snapshot_enabled(emsabp_ctx));
+
+	/* Every search goes to the directory and is not shared */
+	first = get_snapshot();
+	second = get_snapshot();
+	ck_assert(first != second);
+	ck_assert_int_eq(first->expires, 0);
+	ck_assert_int_eq(second->res->count, 3);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void snapshot_setup(void)
+{
+	struct ldb_dn	*basedn;
+	uint32_t	i;
+
+	mem_ctx = talloc_named(NULL, 0, "snapshot_setup");
+	ck_assert(mem_ctx != NULL);
+
+	emsabp_ctx = talloc_zero(mem_ctx, struct emsabp_context);
+	ck_assert(emsabp_ctx != NULL);
+	emsabp_ctx->mem_ctx = emsabp_ctx;
+
+	emsabp_ctx->lp_ctx = loadparm_init(emsabp_ctx);
+	ck_assert(emsabp_ctx->lp_ctx != NULL);
+	ck_assert(lpcfg_set_cmdline(emsabp_ctx->lp_ctx, "exchange_nsp:snapshot_ttl", "300"));
+
+	/* A directory the default base DN of which holds the users */
+	unlink(SNAPSHOT_LDB_PATH);
+	emsabp_ctx->samdb_ctx = ldb_init(emsabp_ctx, NULL);
+	ck_assert(emsabp_ctx->samdb_ctx != NULL);
+	ck_assert_int_eq(ldb_connect(emsabp_ctx->samdb_ctx, SNAPSHOT_LDB_PATH, 0, NULL), LDB_SUCCESS);
+	basedn = ldb_dn_new(emsabp_ctx->samdb_ctx, emsabp_ctx->samdb_ctx, SNAPSHOT_BASEDN);
+	ck_assert(basedn != NULL);
+	ck_assert_int_eq(ldb_set_opaque(emsabp_ctx->samdb_ctx, "default_baseDN", basedn), LDB_SUCCESS);
+
+	for (i = 0; users[i]; i++) {
+		add_user(users[i]);
+	}
+
+	/* Snapshots are process wide: replace the ones of the previous
+	 * test, which may have reached the same sequence number */
+	get_snapshot();
+}
+
+static void snapshot_teardown(void)
+{
+	talloc_free(mem_ctx);
+	unlink(SNAPSHOT_LDB_PATH);
+}
+
+Suite *mapiproxy_servers_emsabp_snapshot_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("mapiproxy/servers/emsabp_snapshot");
+
+	tc = tcase_create("address book snapshots");
+	tcase_add_checked_fixture(tc, snapshot_setup, snapshot_teardown);
+	tcase_add_test(tc, test_snapshot_shared);
+	tcase_add_test(tc, test_snapshot_seq_num);
+	tcase_add_test(tc, test_snapshot_disabled);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
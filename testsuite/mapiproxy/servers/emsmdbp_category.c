@@ -0,0 +1,364 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "emsmdbp_common.h"
+
+/* Rows of the categories A, B and C */
+#define	CATEGORY_A_COUNT	3
+#define	CATEGORY_B_COUNT	4
+#define	CATEGORY_C_COUNT	5
+#define	TABLE_ROW_COUNT		(CATEGORY_A_COUNT + CATEGORY_B_COUNT + CATEGORY_C_COUNT)
+
+/* Global test variables */
+static TALLOC_CTX			*mem_ctx;
+static struct emsmdbp_test_context	*ctx;
+static struct emsmdbp_object_table	*table;
+static struct emsmdbp_test_row		rows[TABLE_ROW_COUNT + 1];
+
+static const enum MAPITAGS		columns[] = {
+	PidTagMessageClass,
+	PidTagMid,
+	PidTagInstID,
+	PidTagInstanceKey,
+	PidTagRowType,
+	PidTagDepth
+};
+
+
+/* Categorize the table on PidTagMessageClass, then PidTagMid */
+static void categorize(uint16_t expanded)
+{
+	struct SSortOrderSet	*sort_order;
+
+	sort_order = talloc_zero(mem_ctx, struct SSortOrderSet);
+	ck_assert(sort_order != NULL);
+	sort_order->cSorts = 2;
+	sort_order->cCategories = 1;
+	sort_order->cExpanded = expanded;
+	sort_order->aSort = talloc_array(sort_order, struct SSortOrder, 2);
+	ck_assert(sort_order->aSort != NULL);
+	sort_order->aSort[0].ulPropTag = PidTagMessageClass;
+	sort_order->aSort[0].ulOrder = TABLE_SORT_ASCEND;
+	sort_order->aSort[1].ulPropTag = PidTagMid;
+	sort_order->aSort[1].ulOrder = TABLE_SORT_ASCEND;
+
+	ck_assert_int_eq(emsmdbp_object_table_categorize(ctx->emsmdbp_ctx, ctx->table_object, sort_order), MAPI_E_SUCCESS);
+	ck_assert(table->categories != NULL);
+	talloc_free(sort_order);
+}
+
+static struct emsmdbp_table_category *header(uint32_t index)
+{
+	ck_assert_int_lt(index, table->categories->count);
+	return &table->categories->headers[index];
+}
+
+static void check_header(uint32_t position, struct emsmdbp_table_category *expected)
+{
+	struct emsmdbp_table_category	*found = NULL;
+	uint32_t			row_id;
+
+	ck_assert(emsmdbp_object_table_category_locate(table, position, &found, &row_id));
+	ck_assert(found == expected);
+}
+
+static void check_leaf(uint32_t position, uint32_t expected)
+{
+	struct emsmdbp_table_category	*found = NULL;
+	uint32_t			row_id = 0;
+
+	ck_assert(emsmdbp_object_table_category_locate(table, position, &found, &row_id));
+	ck_assert(found == NULL);
+	ck_assert_int_eq(row_id, expected);
+}
+
+static void call_rop(uint8_t opnum, struct EcDoRpc_MAPI_REQ *req, struct EcDoRpc_MAPI_REPL *repl)
+{
+	uint32_t		handles[1] = { ctx->table_handle };
+	uint16_t		size = 0;
+	enum MAPISTATUS		retval;
+
+	req->opnum = opnum;
+	req->handle_idx = 0;
+	memset(repl, 0, sizeof (struct EcDoRpc_MAPI_REPL));
+
+	switch (opnum) {
+	case op_MAPI_ExpandRow:
+		retval = EcDoRpc_RopExpandRow(mem_ctx, ctx->emsmdbp_ctx, req, repl, handles, &size);
+		break;
+	case op_MAPI_CollapseRow:
+		retval = EcDoRpc_RopCollapseRow(mem_ctx, ctx->emsmdbp_ctx, req, repl, handles, &size);
+		break;
+	case op_MAPI_GetCollapseState:
+		retval = EcDoRpc_RopGetCollapseState(mem_ctx, ctx->emsmdbp_ctx, req, repl, handles, &size);
+		break;
+	case op_MAPI_SetCollapseState:
+		retval = EcDoRpc_RopSetCollapseState(mem_ctx, ctx->emsmdbp_ctx, req, repl, handles, &size);
+		break;
+	default:
+		ck_abort();
+		return;
+	}
+	ck_assert_int_eq(retval, MAPI_E_SUCCESS);
+}
+
+static enum MAPISTATUS expand_row(struct emsmdbp_table_category *category, uint16_t max_rows,
+				  struct EcDoRpc_MAPI_REPL *repl)
+{
+	struct EcDoRpc_MAPI_REQ	req;
+
+	memset(&req, 0, sizeof (req));
+	req.u.mapi_ExpandRow.MaxRowCount = max_rows;
+	req.u.mapi_ExpandRow.CategoryId = category->id;
+	call_rop(op_MAPI_ExpandRow, &req, repl);
+
+	return repl->error_code;
+}
+
+static enum MAPISTATUS collapse_row(uint64_t category_id, struct EcDoRpc_MAPI_REPL *repl)
+{
+	struct EcDoRpc_MAPI_REQ	req;
+
+	memset(&req, 0, sizeof (req));
+	req.u.mapi_CollapseRow.CategoryId = category_id;
+	call_rop(op_MAPI_CollapseRow, &req, repl);
+
+	return repl->error_code;
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_category_layout) {
+	categorize(1);
+
+	/* One header per value, in table order */
+	ck_assert_int_eq(table->categories->count, 3);
+	ck_assert_int_eq(table->categories->row_count, TABLE_ROW_COUNT);
+	ck_assert_int_eq(header(0)->count, CATEGORY_A_COUNT);
+	ck_assert_int_eq(header(1)->count, CATEGORY_B_COUNT);
+	ck_assert_int_eq(header(2)->count, CATEGORY_C_COUNT);
+	ck_assert_int_eq(header(1)->start, CATEGORY_A_COUNT);
+	ck_assert_str_eq((const char *) header(1)->value, "IPM.B");
+
+	/* Values differing in case only share their category */
+	ck_assert_str_eq(rows[CATEGORY_A_COUNT + 1].category, "ipm.b");
+
+	/* Expanded: the headers followed by their rows */
+	ck_assert_int_eq(table->denominator, 3 + TABLE_ROW_COUNT);
+	check_header(0, header(0));
+	check_leaf(1, 0);
+	check_leaf(3, 2);
+	check_header(4, header(1));
+	check_leaf(5, 3);
+	check_header(9, header(2));
+	check_leaf(14, TABLE_ROW_COUNT - 1);
+	ck_assert(!emsmdbp_object_table_category_locate(table, 15, NULL, NULL));
+
+	/* Identifiers only depend on the values */
+	ck_assert(header(0)->id != header(1)->id);
+	ck_assert(emsmdbp_object_table_category_find(table, header(2)->id) == header(2));
+} END_TEST
+
+START_TEST (test_category_collapsed) {
+	categorize(0);
+
+	ck_assert_int_eq(table->denominator, 3);
+	check_header(0, header(0));
+	check_header(1, header(1));
+	check_header(2, header(2));
+	ck_assert(!emsmdbp_object_table_category_locate(table, 3, NULL, NULL));
+} END_TEST
+
+START_TEST (test_category_expand) {
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	categorize(0);
+
+	/* The cursor on the next header follows it */
+	table->numerator = 2;
+	ck_assert_int_eq(expand_row(header(1), 2, &repl), MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl.u.mapi_ExpandRow.ExpandedRowCount, CATEGORY_B_COUNT);
+	ck_assert_int_eq(repl.u.mapi_ExpandRow.RowCount, 2);
+	ck_assert(repl.u.mapi_ExpandRow.RowData.length > 0);
+
+	ck_assert_int_eq(table->denominator, 3 + CATEGORY_B_COUNT);
+	ck_assert_int_eq(table->numerator, 2 + CATEGORY_B_COUNT);
+	check_header(1, header(1));
+	check_leaf(2, CATEGORY_A_COUNT);
+	check_header(2 + CATEGORY_B_COUNT, header(2));
+
+	/* Twice is an error */
+	ck_assert_int_eq(expand_row(header(1), 0, &repl), ecNotCollapsed);
+	ck_assert_int_eq(table->denominator, 3 + CATEGORY_B_COUNT);
+} END_TEST
+
+START_TEST (test_category_collapse) {
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	categorize(1);
+
+	/* The cursor on a hidden row moves to the next category */
+	table->numerator = 6;
+	ck_assert_int_eq(collapse_row(header(1)->id, &repl), MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl.u.mapi_CollapseRow.CollapsedRowCount, CATEGORY_B_COUNT);
+	ck_assert_int_eq(table->denominator, 3 + CATEGORY_A_COUNT + CATEGORY_C_COUNT);
+	ck_assert_int_eq(table->numerator, header(2)->position);
+	check_header(4, header(1));
+	check_header(5, header(2));
+
+	/* The cursor after the category keeps pointing at its row */
+	table->numerator = 7;
+	ck_assert_int_eq(collapse_row(header(0)->id, &repl), MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl.u.mapi_CollapseRow.CollapsedRowCount, CATEGORY_A_COUNT);
+	ck_assert_int_eq(table->numerator, 7 - CATEGORY_A_COUNT);
+	check_leaf(table->numerator, CATEGORY_A_COUNT + CATEGORY_B_COUNT + 1);
+
+	ck_assert_int_eq(collapse_row(header(0)->id, &repl), ecNotExpanded);
+	ck_assert_int_eq(collapse_row(0x1234, &repl), MAPI_E_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_category_state_round_trip) {
+	struct EcDoRpc_MAPI_REQ		req;
+	struct EcDoRpc_MAPI_REPL	repl;
+	struct SBinary_short		state;
+	uint64_t			cursor_id;
+
+	categorize(0);
+
+	ck_assert_int_eq(expand_row(header(0), 0, &repl), MAPI_E_SUCCESS);
+	ck_assert_int_eq(expand_row(header(2), 0, &repl), MAPI_E_SUCCESS);
+	table->numerator = header(2)->position;
+	cursor_id = header(2)->id;
+
+	memset(&req, 0, sizeof (req));
+	req.u.mapi_GetCollapseState.RowId = cursor_id;
+	call_rop(op_MAPI_GetCollapseState, &req, &repl);
+	ck_assert_int_eq(repl.error_code, MAPI_E_SUCCESS);
+	state = repl.u.mapi_GetCollapseState.CollapseState;
+	ck_assert(state.cb > 0);
+
+	/* The table is sorted again: every category is collapsed */
+	categorize(0);
+	table->numerator = 0;
+	ck_assert_int_eq(table->denominator, 3);
+
+	memset(&req, 0, sizeof (req));
+	req.u.mapi_SetCollapseState.CollapseState = state;
+	call_rop(op_MAPI_SetCollapseState, &req, &repl);
+	ck_assert_int_eq(repl.error_code, MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl.u.mapi_SetCollapseState.bookmark.cb, 4);
+
+	ck_assert(header(0)->expanded);
+	ck_assert(!header(1)->expanded);
+	ck_assert(header(2)->expanded);
+	ck_assert_int_eq(table->denominator, 3 + CATEGORY_A_COUNT + CATEGORY_C_COUNT);
+	ck_assert_int_eq(table->numerator, header(2)->position);
+	ck_assert(header(2)->id == cursor_id);
+
+	/* A truncated state is rejected */
+	state.cb--;
+	req.u.mapi_SetCollapseState.CollapseState = state;
+	call_rop(op_MAPI_SetCollapseState, &req, &repl);
+	ck_assert_int_eq(repl.error_code, MAPI_E_INVALID_PARAMETER);
+} END_TEST
+
+START_TEST (test_category_refresh) {
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	categorize(0);
+	ck_assert_int_eq(expand_row(header(1), 0, &repl), MAPI_E_SUCCESS);
+
+	/* A message is added to B and the session is notified */
+	memmove(&rows[CATEGORY_A_COUNT + 1], &rows[CATEGORY_A_COUNT],
+		(TABLE_ROW_COUNT - CATEGORY_A_COUNT) * sizeof (struct emsmdbp_test_row));
+	rows[CATEGORY_A_COUNT].mid = 0x2000;
+	emsmdbp_test_table_set_rows(ctx, rows, TABLE_ROW_COUNT + 1);
+	ctx->emsmdbp_ctx->table_generation++;
+
+	/* Categories are rebuilt and keep their state */
+	ck_assert_int_eq(emsmdbp_object_table_categories_refresh(ctx->emsmdbp_ctx, ctx->table_object, false), MAPI_E_SUCCESS);
+	ck_assert_int_eq(table->categories->count, 3);
+	ck_assert(!header(0)->expanded);
+	ck_assert(header(1)->expanded);
+	ck_assert_int_eq(header(1)->count, CATEGORY_B_COUNT + 1);
+	ck_assert_int_eq(header(2)->start, CATEGORY_A_COUNT + CATEGORY_B_COUNT + 1);
+	ck_assert_int_eq(table->denominator, 3 + CATEGORY_B_COUNT + 1);
+
+	/* The view is flat again once the categories are dropped */
+	emsmdbp_object_table_categories_reset(table);
+	ck_assert(table->categories == NULL);
+	ck_assert_int_eq(table->denominator, TABLE_ROW_COUNT + 1);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void category_setup(void)
+{
+	uint32_t	i;
+
+	mem_ctx = talloc_named(NULL, 0, "category_setup");
+	ck_assert(mem_ctx != NULL);
+
+	ctx = emsmdbp_test_context_init(mem_ctx);
+	table = ctx->table_object->object.table;
+
+	/* Sorted on the category */
+	memset(rows, 0, sizeof (rows));
+	for (i = 0; i < TABLE_ROW_COUNT; i++) {
+		rows[i].mid = 0x1000 + i;
+		rows[i].size = i;
+		if (i < CATEGORY_A_COUNT) {
+			rows[i].category = "IPM.A";
+		} else if (i < CATEGORY_A_COUNT + CATEGORY_B_COUNT) {
+			rows[i].category = (i % 2) ? "IPM.B" : "ipm.b";
+		} else {
+			rows[i].category = "IPM.C";
+		}
+	}
+	emsmdbp_test_table_set_rows(ctx, rows, TABLE_ROW_COUNT);
+	emsmdbp_test_table_set_columns(ctx, columns, sizeof (columns) / sizeof (columns[0]));
+}
+
+static void category_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_servers_emsmdbp_category_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("mapiproxy/servers/emsmdbp_category");
+
+	tc = tcase_create("categorized views");
+	tcase_add_checked_fixture(tc, category_setup, category_teardown);
+	tcase_add_test(tc, test_category_layout);
+	tcase_add_test(tc, test_category_collapsed);
+	tcase_add_test(tc, test_category_expand);
+	tcase_add_test(tc, test_category_collapse);
+	tcase_add_test(tc, test_category_state_round_trip);
+	tcase_add_test(tc, test_category_refresh);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
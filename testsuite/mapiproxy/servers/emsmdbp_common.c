@@ -0,0 +1,287 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "emsmdbp_common.h"
+#include "mapiproxy/libmapistore/mapistore_errors.h"
+
+static struct mapistore_backend	test_backend;
+
+
+static void *test_row_property(TALLOC_CTX *mem_ctx, struct emsmdbp_test_row *row, enum MAPITAGS proptag)
+{
+	struct Binary_r	*bin;
+
+	switch (proptag) {
+	case PidTagMid:
+		return &row->mid;
+	case PidTagMessageSize:
+		return &row->size;
+	case PidTagSubject:
+		return (void *) row->subject;
+	case PidTagMessageClass:
+		return (void *) row->category;
+	case PidTagInstanceKey:
+		bin = talloc_zero(mem_ctx, struct Binary_r);
+		if (!bin) return NULL;
+		bin->cb = sizeof (row->mid);
+		bin->lpb = talloc_memdup(bin, &row->mid, sizeof (row->mid));
+		return bin;
+	default:
+		return NULL;
+	}
+}
+
+static enum mapistore_error test_table_get_row(void *table_object, TALLOC_CTX *mem_ctx,
+					       enum mapistore_query_type query_type, uint32_t row_id,
+					       struct mapistore_property_data **datap)
+{
+	struct emsmdbp_test_table	*table = (struct emsmdbp_test_table *) table_object;
+	struct mapistore_property_data	*data;
+	uint16_t			i;
+
+	table->get_row_calls++;
+	if (row_id >= table->count) {
+		return MAPISTORE_ERR_NOT_FOUND;
+	}
+
+	data = talloc_zero_array(mem_ctx, struct mapistore_property_data, table->column_count);
+	if (!data) {
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	for (i = 0; i < table->column_count; i++) {
+		data[i].data = test_row_property(data, &table->rows[row_id], table->columns[i]);
+		data[i].error = data[i].data ? MAPISTORE_SUCCESS : MAPISTORE_ERR_NOT_FOUND;
+	}
+	*datap = data;
+
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error test_table_set_columns(void *table_object, uint16_t count, enum MAPITAGS *columns)
+{
+	struct emsmdbp_test_table	*table = (struct emsmdbp_test_table *) table_object;
+	enum MAPITAGS			*copy;
+
+	copy = talloc_memdup(table, columns, count * sizeof (enum MAPITAGS));
+	if (!copy) {
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	table->columns = copy;
+	table->column_count = count;
+
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error test_table_get_row_count(void *table_object, enum mapistore_query_type query_type,
+						     uint32_t *row_countp)
+{
+	*row_countp = ((struct emsmdbp_test_table *) table_object)->count;
+	return MAPISTORE_SUCCESS;
+}
+
+static enum mapistore_error test_folder_open_message(void *folder_object, TALLOC_CTX *mem_ctx, uint64_t mid,
+						     bool read_write, void **messagep)
+{
+	struct emsmdbp_test_folder	*folder = (struct emsmdbp_test_folder *) folder_object;
+	struct emsmdbp_test_message	*message;
+	uint32_t			i;
+
+	folder->open_message_calls++;
+	for (i = 0; i < folder->table->count; i++) {
+		if (folder->table->rows[i].mid == mid) break;
+	}
+	if (i == folder->table->count) {
+		return MAPISTORE_ERR_NOT_FOUND;
+	}
+
+	message = talloc_zero(mem_ctx, struct emsmdbp_test_message);
+	if (!message) {
+		return MAPISTORE_ERR_NO_MEMORY;
+	}
+	message->mid = mid;
+	*messagep = message;
+
+	return MAPISTORE_SUCCESS;
+}
+
+/* Let the provider evaluate restrictions on the column set */
+static enum mapistore_error test_table_set_restrictions(void *table_object, struct mapi_SRestriction *res,
+							uint8_t *table_status)
+{
+	return MAPISTORE_ERR_NOT_IMPLEMENTED;
+}
+
+
+/**
+   \details Create an emsmdb provider context with a mailbox, the root
+   folder of a mapistore context under it and an empty contents table
+   opened on the folder, all registered in the handles of the context
+
+   \param mem_ctx pointer to the memory context
+
+   \return pointer to the test context
+ */
+struct emsmdbp_test_context *emsmdbp_test_context_init(TALLOC_CTX *mem_ctx)
+{
+	struct emsmdbp_test_context	*ctx;
+	struct emsmdbp_context		*emsmdbp_ctx;
+	struct processing_context	*pctx;
+	struct backend_context_list	*el;
+	struct mapi_handles		*rec;
+	uint32_t			mailbox_handle;
+
+	memset(&test_backend, 0, sizeof (test_backend));
+	test_backend.backend.name = "emsmdbptest";
+	test_backend.table.set_columns = test_table_set_columns;
+	test_backend.table.get_row = test_table_get_row;
+	test_backend.table.get_row_count = test_table_get_row_count;
+	test_backend.table.set_restrictions = test_table_set_restrictions;
+	test_backend.folder.open_message = test_folder_open_message;
+	mapistore_set_backend_profiling(false, 0);
+
+	ctx = talloc_zero(mem_ctx, struct emsmdbp_test_context);
+	ck_assert(ctx != NULL);
+	ctx->mem_ctx = ctx;
+
+	emsmdbp_ctx = talloc_zero(ctx, struct emsmdbp_context);
+	ck_assert(emsmdbp_ctx != NULL);
+	emsmdbp_ctx->mem_ctx = emsmdbp_ctx;
+	emsmdbp_ctx->username = talloc_strdup(emsmdbp_ctx, EMSMDBP_TEST_USERNAME);
+	emsmdbp_ctx->table_generation = 1;
+	ctx->emsmdbp_ctx = emsmdbp_ctx;
+
+	/* The folder and its contents table, in the fake backend */
+	ctx->table = talloc_zero(ctx, struct emsmdbp_test_table);
+	ck_assert(ctx->table != NULL);
+	ctx->backend_folder = talloc_zero(ctx, struct emsmdbp_test_folder);
+	ck_assert(ctx->backend_folder != NULL);
+	ctx->backend_folder->table = ctx->table;
+
+	/* A mapistore context served by the fake backend, registered
+	 * as mapistore_add_context does */
+	emsmdbp_ctx->mstore_ctx = talloc_zero(emsmdbp_ctx, struct mapistore_context);
+	ck_assert(emsmdbp_ctx->mstore_ctx != NULL);
+	pctx = talloc_zero(emsmdbp_ctx->mstore_ctx, struct processing_context);
+	ck_assert(pctx != NULL);
+	emsmdbp_ctx->mstore_ctx->processing_ctx = pctx;
+
+	el = talloc_zero(emsmdbp_ctx->mstore_ctx, struct backend_context_list);
+	ck_assert(el != NULL);
+	el->ctx = talloc_zero(el, struct backend_context);
+	ck_assert(el->ctx != NULL);
+	el->ctx->backend = &test_backend;
+	el->ctx->uri = talloc_strdup(el->ctx, EMSMDBP_TEST_URI);
+	el->ctx->root_folder_object = ctx->backend_folder;
+	el->ctx->indexing = talloc_zero(el->ctx, struct indexing_context);
+	ck_assert(el->ctx->indexing != NULL);
+	el->ctx->ref_count = 1;
+	ck_assert_int_eq(mapistore_get_context_id(pctx, &el->ctx->context_id), MAPISTORE_SUCCESS);
+	ck_assert_int_eq(mapistore_register_context(pctx, el), MAPISTORE_SUCCESS);
+	DLIST_ADD_END(emsmdbp_ctx->mstore_ctx->context_list, el, struct backend_context_list *);
+	ctx->backend_ctx = el->ctx;
+
+	emsmdbp_ctx->handles_ctx = mapi_handles_init(emsmdbp_ctx);
+	ck_assert(emsmdbp_ctx->handles_ctx != NULL);
+
+	/* The mailbox the folder belongs to */
+	ctx->mailbox = talloc_zero(ctx, struct emsmdbp_object);
+	ck_assert(ctx->mailbox != NULL);
+	ctx->mailbox->type = EMSMDBP_OBJECT_MAILBOX;
+	ctx->mailbox->emsmdbp_ctx = emsmdbp_ctx;
+	ctx->mailbox->object.mailbox = talloc_zero(ctx->mailbox, struct emsmdbp_object_mailbox);
+	ck_assert(ctx->mailbox->object.mailbox != NULL);
+	ctx->mailbox->object.mailbox->owner_username = emsmdbp_ctx->username;
+	ctx->mailbox->object.mailbox->mailboxstore = true;
+
+	ck_assert_int_eq(mapi_handles_add(emsmdbp_ctx->handles_ctx, 0, &rec), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_handles_set_private_data(rec, ctx->mailbox), MAPI_E_SUCCESS);
+	mailbox_handle = rec->handle;
+
+	/* The root folder of the context */
+	ctx->folder = talloc_zero(ctx, struct emsmdbp_object);
+	ck_assert(ctx->folder != NULL);
+	ctx->folder->type = EMSMDBP_OBJECT_FOLDER;
+	ctx->folder->emsmdbp_ctx = emsmdbp_ctx;
+	ctx->folder->parent_object = ctx->mailbox;
+	ctx->folder->backend_object = ctx->backend_folder;
+	ctx->folder->object.folder = talloc_zero(ctx->folder, struct emsmdbp_object_folder);
+	ck_assert(ctx->folder->object.folder != NULL);
+	ctx->folder->object.folder->folderID = EMSMDBP_TEST_FID;
+	ctx->folder->object.folder->mapistore_root = true;
+	ctx->folder->object.folder->contextID = el->ctx->context_id;
+
+	ck_assert_int_eq(mapi_handles_add(emsmdbp_ctx->handles_ctx, mailbox_handle, &rec), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_handles_set_private_data(rec, ctx->folder), MAPI_E_SUCCESS);
+	ctx->folder_handle = rec->handle;
+
+	/* Its contents table */
+
+	ctx->table_object = talloc_zero(ctx, struct emsmdbp_object);
+	ck_assert(ctx->table_object != NULL);
+	ctx->table_object->type = EMSMDBP_OBJECT_TABLE;
+	ctx->table_object->emsmdbp_ctx = emsmdbp_ctx;
+	ctx->table_object->parent_object = ctx->folder;
+	ctx->table_object->backend_object = ctx->table;
+	ctx->table_object->object.table = talloc_zero(ctx->table_object, struct emsmdbp_object_table);
+	ck_assert(ctx->table_object->object.table != NULL);
+	ctx->table_object->object.table->ulType = MAPISTORE_MESSAGE_TABLE;
+
+	ck_assert_int_eq(mapi_handles_add(emsmdbp_ctx->handles_ctx, ctx->folder_handle, &rec), MAPI_E_SUCCESS);
+	ck_assert_int_eq(mapi_handles_set_private_data(rec, ctx->table_object), MAPI_E_SUCCESS);
+	ctx->table_handle = rec->handle;
+	ctx->table_object->object.table->handle = rec->handle;
+
+	return ctx;
+}
+
+/**
+   \details Replace the rows of the fake table, as the backend would
+   after a change, and update the row count of the table object
+
+   \param ctx pointer to the test context
+   \param rows the rows, kept by reference
+   \param count the number of rows
+ */
+void emsmdbp_test_table_set_rows(struct emsmdbp_test_context *ctx, struct emsmdbp_test_row *rows, uint32_t count)
+{
+	ctx->table->rows = rows;
+	ctx->table->count = count;
+	ctx->table_object->object.table->denominator = count;
+}
+
+/**
+   \details Set the column set of the table object and of the fake
+   table, as SetColumns does
+
+   \param ctx pointer to the test context
+   \param columns the property tags of the columns
+   \param count the number of columns
+ */
+void emsmdbp_test_table_set_columns(struct emsmdbp_test_context *ctx, const enum MAPITAGS *columns, uint16_t count)
+{
+	struct emsmdbp_object_table	*table = ctx->table_object->object.table;
+
+	table->properties = talloc_memdup(table, columns, count * sizeof (enum MAPITAGS));
+	ck_assert(table->properties != NULL);
+	table->prop_count = count;
+
+	ctx->table->columns = table->properties;
+	ctx->table->column_count = count;
+}
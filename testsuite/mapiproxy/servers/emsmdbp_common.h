@@ -0,0 +1,78 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __EMSMDBP_COMMON_H__
+#define __EMSMDBP_COMMON_H__
+
+#include "mapiproxy/servers/default/emsmdb/dcesrv_exchange_emsmdb.h"
+#include "mapiproxy/libmapistore/mapistore_private.h"
+
+#define	EMSMDBP_TEST_USERNAME	"testuser"
+#define	EMSMDBP_TEST_URI	"emsmdbptest://folder/"
+#define	EMSMDBP_TEST_FID	0x10001
+
+/* A message of the fake mapistore table */
+struct emsmdbp_test_row {
+	uint64_t		mid;
+	uint32_t		size;
+	const char		*subject;
+	const char		*category;	/* read as PidTagMessageClass */
+};
+
+/* The backend object of the fake mapistore table */
+struct emsmdbp_test_table {
+	struct emsmdbp_test_row	*rows;
+	uint32_t		count;
+	enum MAPITAGS		*columns;
+	uint16_t		column_count;
+	uint32_t		get_row_calls;
+};
+
+/* The backend object of the fake mapistore folder: its messages are
+ * the rows of its contents table */
+struct emsmdbp_test_folder {
+	struct emsmdbp_test_table *table;
+	uint32_t		open_message_calls;
+};
+
+/* The backend object of a fake mapistore message */
+struct emsmdbp_test_message {
+	uint64_t		mid;
+};
+
+/* An emsmdb provider context whose folder lives in a fake mapistore
+ * backend, with a contents table opened on it */
+struct emsmdbp_test_context {
+	TALLOC_CTX		*mem_ctx;
+	struct emsmdbp_context	*emsmdbp_ctx;
+	struct backend_context	*backend_ctx;
+	struct emsmdbp_object	*mailbox;
+	struct emsmdbp_object	*folder;
+	uint32_t		folder_handle;
+	struct emsmdbp_test_folder *backend_folder;
+	struct emsmdbp_object	*table_object;
+	uint32_t		table_handle;
+	struct emsmdbp_test_table *table;
+};
+
+struct emsmdbp_test_context *emsmdbp_test_context_init(TALLOC_CTX *);
+void emsmdbp_test_table_set_rows(struct emsmdbp_test_context *, struct emsmdbp_test_row *, uint32_t);
+void emsmdbp_test_table_set_columns(struct emsmdbp_test_context *, const enum MAPITAGS *, uint16_t);
+
+#endif /* __EMSMDBP_COMMON_H__ */
@@ -0,0 +1,255 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "emsmdbp_common.h"
+
+#define	ROW_COUNT	8
+
+/* Global test variables */
+static TALLOC_CTX			*mem_ctx;
+static struct emsmdbp_test_context	*ctx;
+static struct emsmdbp_test_row		rows[ROW_COUNT];
+
+static const enum MAPITAGS columns[] = { PidTagMid, PidTagMessageSize, PidTagSubject };
+
+
+/* The mapistore URI of the folder, as openchangedb has it */
+static enum MAPISTATUS test_get_mapistoreURI(TALLOC_CTX *parent_ctx, struct openchangedb_context *oc_ctx,
+					     const char *username, uint64_t fid, char **mapistoreURL,
+					     bool mailboxstore)
+{
+	OPENCHANGE_RETVAL_IF(fid != EMSMDBP_TEST_FID, MAPI_E_NOT_FOUND, NULL);
+
+	*mapistoreURL = talloc_strdup(parent_ctx, EMSMDBP_TEST_URI);
+	OPENCHANGE_RETVAL_IF(!*mapistoreURL, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+	return MAPI_E_SUCCESS;
+}
+
+/* Open a message of the folder for reading, as OpenMessage does */
+static struct emsmdbp_object *open_message(uint64_t mid, uint32_t *handlep)
+{
+	struct mapi_handles	*rec;
+	struct emsmdbp_object	*message;
+
+	ck_assert_int_eq(mapi_handles_add(ctx->emsmdbp_ctx->handles_ctx, ctx->folder_handle, &rec), MAPI_E_SUCCESS);
+
+	message = talloc_zero(rec, struct emsmdbp_object);
+	ck_assert(message != NULL);
+	message->type = EMSMDBP_OBJECT_MESSAGE;
+	message->emsmdbp_ctx = ctx->emsmdbp_ctx;
+	message->parent_object = ctx->folder;
+	message->object.message = talloc_zero(message, struct emsmdbp_object_message);
+	ck_assert(message->object.message != NULL);
+	message->object.message->messageID = mid;
+	ck_assert_int_eq(mapistore_folder_open_message(ctx->emsmdbp_ctx->mstore_ctx, emsmdbp_get_contextID(ctx->folder),
+						       ctx->folder->backend_object, message, mid, false,
+						       &message->backend_object), MAPISTORE_SUCCESS);
+
+	ck_assert_int_eq(mapi_handles_set_private_data(rec, message), MAPI_E_SUCCESS);
+	*handlep = rec->handle;
+
+	return message;
+}
+
+static struct emsmdbp_object *handle_object(uint32_t handle)
+{
+	struct mapi_handles	*rec;
+	void			*private_data = NULL;
+
+	if (mapi_handles_search(ctx->emsmdbp_ctx->handles_ctx, handle, &rec) != MAPI_E_SUCCESS) {
+		return NULL;
+	}
+	ck_assert_int_eq(mapi_handles_get_private_data(rec, &private_data), MAPI_E_SUCCESS);
+
+	return (struct emsmdbp_object *) private_data;
+}
+
+/* Read a row of the table the way QueryRows does */
+static void check_table_row(uint32_t row_id)
+{
+	struct emsmdbp_object	*table_object;
+	enum MAPISTATUS		*retvals = NULL;
+	void			**data;
+
+	table_object = handle_object(ctx->table_handle);
+	ck_assert(table_object == ctx->table_object);
+
+	data = emsmdbp_object_table_get_row_props(mem_ctx, ctx->emsmdbp_ctx, table_object, row_id,
+						  MAPISTORE_PREFILTERED_QUERY, &retvals);
+	ck_assert(data != NULL);
+	ck_assert_int_eq(retvals[0], MAPI_E_SUCCESS);
+	ck_assert(*(uint64_t *) data[0] == rows[row_id].mid);
+	ck_assert_int_eq(retvals[2], MAPI_E_SUCCESS);
+	ck_assert_str_eq((const char *) data[2], rows[row_id].subject);
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_idle_busy_context) {
+	struct emsmdbp_object	*message;
+	void			*message_backend;
+	uint32_t		message_handle;
+	uint32_t		get_row_calls;
+
+	message = open_message(rows[2].mid, &message_handle);
+	message_backend = message->backend_object;
+
+	/* The open table keeps the state of its context: nothing of it
+	   is released */
+	emsmdbp_idle_hibernate(ctx->emsmdbp_ctx);
+	ck_assert(ctx->emsmdbp_ctx->hibernated == NULL);
+	ck_assert(ctx->folder->backend_object == ctx->backend_folder);
+	ck_assert(!ctx->folder->hibernated);
+	ck_assert(message->backend_object == message_backend);
+	ck_assert_int_eq(ctx->backend_ctx->ref_count, 1);
+
+	/* The next call goes on with the same folder and table handles */
+	emsmdbp_idle_touch(ctx->emsmdbp_ctx);
+	ck_assert(handle_object(ctx->folder_handle) == ctx->folder);
+	ck_assert(handle_object(message_handle) == message);
+	get_row_calls = ctx->table->get_row_calls;
+	check_table_row(3);
+	ck_assert_int_gt(ctx->table->get_row_calls, get_row_calls);
+	ck_assert_int_eq(ctx->backend_folder->open_message_calls, 1);
+} END_TEST
+
+START_TEST (test_idle_resume) {
+	struct emsmdbp_object	*message;
+	struct emsmdbp_object	*other;
+	uint32_t		message_handle;
+	uint32_t		other_handle;
+
+	/* The client released its table, another session of the
+	   mailbox keeps the context open */
+	ck_assert_int_eq(mapi_handles_delete(ctx->emsmdbp_ctx->handles_ctx, ctx->table_handle), MAPI_E_SUCCESS);
+	ctx->backend_ctx->ref_count = 2;
+	message = open_message(rows[2].mid, &message_handle);
+
+	emsmdbp_idle_hibernate(ctx->emsmdbp_ctx);
+	ck_assert_int_eq(ctx->emsmdbp_ctx->hibernated_count, 2);
+	ck_assert(ctx->folder->backend_object == NULL);
+	ck_assert(ctx->folder->hibernated);
+	ck_assert(message->backend_object == NULL);
+	ck_assert(message->hibernated);
+	ck_assert_int_eq(ctx->backend_ctx->ref_count, 1);
+
+	/* Hibernating twice is harmless */
+	emsmdbp_idle_hibernate(ctx->emsmdbp_ctx);
+	ck_assert_int_eq(ctx->emsmdbp_ctx->hibernated_count, 2);
+
+	/* The next call reopens them behind the same handles */
+	emsmdbp_idle_touch(ctx->emsmdbp_ctx);
+	ck_assert(ctx->emsmdbp_ctx->hibernated == NULL);
+	ck_assert(handle_object(ctx->folder_handle) == ctx->folder);
+	ck_assert(ctx->folder->backend_object == ctx->backend_folder);
+	ck_assert(!ctx->folder->hibernated);
+	ck_assert_int_eq(ctx->backend_ctx->ref_count, 2);
+	ck_assert(handle_object(message_handle) == message);
+	ck_assert(message->backend_object != NULL);
+	ck_assert(((struct emsmdbp_test_message *) message->backend_object)->mid == rows[2].mid);
+	ck_assert(!message->hibernated);
+	ck_assert_int_eq(ctx->backend_folder->open_message_calls, 2);
+
+	/* The folder handle is usable as before */
+	other = open_message(rows[5].mid, &other_handle);
+	ck_assert(((struct emsmdbp_test_message *) other->backend_object)->mid == rows[5].mid);
+	ck_assert(handle_object(other_handle) == other);
+} END_TEST
+
+START_TEST (test_idle_lost) {
+	struct emsmdbp_object	*message;
+	uint32_t		message_handle;
+	uint32_t		kept_handle;
+
+	ck_assert_int_eq(mapi_handles_delete(ctx->emsmdbp_ctx->handles_ctx, ctx->table_handle), MAPI_E_SUCCESS);
+	ctx->backend_ctx->ref_count = 2;
+	message = open_message(rows[ROW_COUNT - 1].mid, &message_handle);
+	open_message(rows[0].mid, &kept_handle);
+
+	emsmdbp_idle_hibernate(ctx->emsmdbp_ctx);
+	ck_assert_int_eq(ctx->emsmdbp_ctx->hibernated_count, 3);
+	ck_assert(message->hibernated);
+
+	/* The last message was deleted meanwhile */
+	emsmdbp_test_table_set_rows(ctx, rows, ROW_COUNT - 1);
+
+	/* Only its handle goes away */
+	emsmdbp_idle_touch(ctx->emsmdbp_ctx);
+	ck_assert(handle_object(message_handle) == NULL);
+	ck_assert(handle_object(kept_handle) != NULL);
+	ck_assert(handle_object(ctx->folder_handle) == ctx->folder);
+	ck_assert(ctx->folder->backend_object == ctx->backend_folder);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void idle_setup(void)
+{
+	struct openchangedb_context	*oc_ctx;
+	uint32_t			i;
+
+	mem_ctx = talloc_named(NULL, 0, "idle_setup");
+	ck_assert(mem_ctx != NULL);
+
+	ctx = emsmdbp_test_context_init(mem_ctx);
+	for (i = 0; i < ROW_COUNT; i++) {
+		rows[i].mid = 0x1000 + i;
+		rows[i].size = i * 100;
+		rows[i].subject = talloc_asprintf(mem_ctx, "subject %02u", i);
+		ck_assert(rows[i].subject != NULL);
+		rows[i].category = NULL;
+	}
+	emsmdbp_test_table_set_rows(ctx, rows, ROW_COUNT);
+	emsmdbp_test_table_set_columns(ctx, columns, sizeof (columns) / sizeof (columns[0]));
+
+	/* Hibernation is driven by the test, not by a timer */
+	ctx->emsmdbp_ctx->lp_ctx = loadparm_init(ctx->emsmdbp_ctx);
+	ck_assert(ctx->emsmdbp_ctx->lp_ctx != NULL);
+
+	oc_ctx = talloc_zero(ctx->emsmdbp_ctx, struct openchangedb_context);
+	ck_assert(oc_ctx != NULL);
+	oc_ctx->get_mapistoreURI = test_get_mapistoreURI;
+	ctx->emsmdbp_ctx->oc_ctx = oc_ctx;
+}
+
+static void idle_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_servers_emsmdbp_idle_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("mapiproxy/servers/emsmdbp_idle");
+
+	tc = tcase_create("hibernation");
+	tcase_add_checked_fixture(tc, idle_setup, idle_teardown);
+	tcase_add_test(tc, test_idle_busy_context);
+	tcase_add_test(tc, test_idle_resume);
+	tcase_add_test(tc, test_idle_lost);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,278 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/servers/default/emsmdb/dcesrv_exchange_emsmdb.h"
+
+#define	TABLE_ROW_COUNT	16
+
+/* Global test variables */
+static TALLOC_CTX			*mem_ctx;
+static struct emsmdbp_context		*emsmdbp_ctx;
+static struct emsmdbp_object_table	*table;
+
+
+/* Serialized row of the fake table: its position, in text */
+static void store_row(uint32_t row_id)
+{
+	char	*row;
+
+	row = talloc_asprintf(mem_ctx, "row%u", row_id);
+	ck_assert(row != NULL);
+	emsmdbp_object_table_cache_store(emsmdbp_ctx, table, row_id, (const uint8_t *) row, strlen(row));
+	talloc_free(row);
+}
+
+static bool fetch_row(uint32_t row_id, DATA_BLOB *blob)
+{
+	return emsmdbp_object_table_cache_fetch(mem_ctx, emsmdbp_ctx, table, row_id, blob);
+}
+
+static void check_blob(DATA_BLOB *blob, const char *expected)
+{
+	ck_assert_int_eq(blob->length, strlen(expected));
+	ck_assert(memcmp(blob->data, expected, blob->length) == 0);
+}
+
+/* Fake openchangedb handing out increasing change numbers */
+static uint32_t	allocated_cns;
+
+static enum MAPISTATUS test_get_new_changeNumber(struct openchangedb_context *oc_ctx,
+						 const char *username, uint64_t *cn)
+{
+	allocated_cns++;
+	*cn = 0x100 + allocated_cns;
+	return MAPI_E_SUCCESS;
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_row_cache_hit) {
+	DATA_BLOB	blob = data_blob_null;
+	uint32_t	i;
+
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT);
+	for (i = 0; i < 4; i++) {
+		store_row(i);
+	}
+
+	/* Rows are appended to the QueryRows blob */
+	ck_assert(fetch_row(1, &blob));
+	ck_assert(fetch_row(2, &blob));
+	check_blob(&blob, "row1row2");
+
+	/* Rows which were never read are not */
+	ck_assert(!fetch_row(4, &blob));
+	check_blob(&blob, "row1row2");
+
+	/* Still there on the next call */
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT);
+	blob = data_blob_null;
+	ck_assert(fetch_row(3, &blob));
+	check_blob(&blob, "row3");
+} END_TEST
+
+START_TEST (test_row_cache_not_validated) {
+	DATA_BLOB	blob = data_blob_null;
+
+	/* Tables which were not validated keep nothing */
+	store_row(0);
+	ck_assert(!fetch_row(0, &blob));
+	ck_assert(table->row_cache == NULL);
+} END_TEST
+
+START_TEST (test_row_cache_generation) {
+	DATA_BLOB	blob = data_blob_null;
+
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT);
+	store_row(0);
+
+	/* A notification or a modifying ROP was processed */
+	emsmdbp_ctx->table_generation++;
+	ck_assert(!fetch_row(0, &blob));
+	ck_assert(table->row_cache == NULL);
+
+	/* Rows read at the new generation are served again */
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT);
+	store_row(0);
+	ck_assert(fetch_row(0, &blob));
+	check_blob(&blob, "row0");
+} END_TEST
+
+START_TEST (test_row_cache_row_count) {
+	DATA_BLOB	blob = data_blob_null;
+
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT);
+	store_row(0);
+
+	/* A row was added behind the back of the session */
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT + 1);
+	ck_assert(!fetch_row(0, &blob));
+	ck_assert_int_eq(blob.length, 0);
+} END_TEST
+
+START_TEST (test_row_cache_reset) {
+	DATA_BLOB	blob = data_blob_null;
+
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, TABLE_ROW_COUNT);
+	store_row(0);
+
+	/* SetColumns, SortTable and Restrict drop the rows */
+	emsmdbp_object_table_cache_reset(table);
+	ck_assert(!fetch_row(0, &blob));
+} END_TEST
+
+START_TEST (test_row_cache_seek) {
+	DATA_BLOB	blob = data_blob_null;
+	uint32_t	i;
+
+	emsmdbp_object_table_cache_validate(emsmdbp_ctx, table, EMSMDBP_TABLE_ROW_CACHE_SIZE * 2);
+	for (i = 0; i < TABLE_ROW_COUNT; i++) {
+		store_row(i);
+	}
+
+	/* SeekRow backwards then QueryRows backwards */
+	for (i = 10; i > 7; i--) {
+		ck_assert(fetch_row(i, &blob));
+	}
+	check_blob(&blob, "row10row9row8");
+
+	/* Rows are direct-mapped on their position: seeking one cache
+	   size further replaces the row sharing its slot only */
+	store_row(EMSMDBP_TABLE_ROW_CACHE_SIZE + 2);
+	blob = data_blob_null;
+	ck_assert(!fetch_row(2, &blob));
+	ck_assert(fetch_row(EMSMDBP_TABLE_ROW_CACHE_SIZE + 2, &blob));
+	ck_assert(fetch_row(3, &blob));
+	check_blob(&blob, talloc_asprintf(mem_ctx, "row%urow3", EMSMDBP_TABLE_ROW_CACHE_SIZE + 2));
+} END_TEST
+
+START_TEST (test_change_number_shared) {
+	uint64_t	cn1, cn2;
+
+	/* Changes of the same ROP share one change number */
+	emsmdbp_change_numbers_begin(emsmdbp_ctx);
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user1", &cn1), MAPI_E_SUCCESS);
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user1", &cn2), MAPI_E_SUCCESS);
+	ck_assert(cn1 == cn2);
+	ck_assert_int_eq(allocated_cns, 1);
+	emsmdbp_change_numbers_end(emsmdbp_ctx);
+
+	/* The next ROP allocates a higher one */
+	emsmdbp_change_numbers_begin(emsmdbp_ctx);
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user1", &cn2), MAPI_E_SUCCESS);
+	ck_assert(cn2 > cn1);
+	ck_assert_int_eq(allocated_cns, 2);
+	emsmdbp_change_numbers_end(emsmdbp_ctx);
+} END_TEST
+
+START_TEST (test_change_number_owner) {
+	uint64_t	cn1, cn2;
+
+	/* Mailboxes of other owners get their own change number */
+	emsmdbp_change_numbers_begin(emsmdbp_ctx);
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user1", &cn1), MAPI_E_SUCCESS);
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user2", &cn2), MAPI_E_SUCCESS);
+	ck_assert(cn1 != cn2);
+	ck_assert_int_eq(allocated_cns, 2);
+	emsmdbp_change_numbers_end(emsmdbp_ctx);
+} END_TEST
+
+START_TEST (test_change_number_outside_rop) {
+	uint64_t	cn1, cn2;
+
+	/* Outside of a ROP, every change gets its own change number */
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user1", &cn1), MAPI_E_SUCCESS);
+	ck_assert_int_eq(emsmdbp_change_number(emsmdbp_ctx, "user1", &cn2), MAPI_E_SUCCESS);
+	ck_assert(cn2 > cn1);
+	ck_assert_int_eq(allocated_cns, 2);
+	ck_assert(emsmdbp_ctx->shared_cn_owner == NULL);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void row_cache_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "row_cache_setup");
+	ck_assert(mem_ctx != NULL);
+
+	emsmdbp_ctx = talloc_zero(mem_ctx, struct emsmdbp_context);
+	ck_assert(emsmdbp_ctx != NULL);
+	emsmdbp_ctx->table_generation = 1;
+
+	table = talloc_zero(mem_ctx, struct emsmdbp_object_table);
+	ck_assert(table != NULL);
+}
+
+static void row_cache_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+static void change_number_setup(void)
+{
+	struct openchangedb_context	*oc_ctx;
+
+	mem_ctx = talloc_named(NULL, 0, "change_number_setup");
+	ck_assert(mem_ctx != NULL);
+
+	emsmdbp_ctx = talloc_zero(mem_ctx, struct emsmdbp_context);
+	ck_assert(emsmdbp_ctx != NULL);
+
+	oc_ctx = talloc_zero(emsmdbp_ctx, struct openchangedb_context);
+	ck_assert(oc_ctx != NULL);
+	oc_ctx->get_new_changeNumber = test_get_new_changeNumber;
+	emsmdbp_ctx->oc_ctx = oc_ctx;
+
+	allocated_cns = 0;
+}
+
+static void change_number_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_servers_emsmdbp_object_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("mapiproxy/servers/emsmdbp_object");
+
+	tc = tcase_create("table row cache");
+	tcase_add_checked_fixture(tc, row_cache_setup, row_cache_teardown);
+	tcase_add_test(tc, test_row_cache_hit);
+	tcase_add_test(tc, test_row_cache_not_validated);
+	tcase_add_test(tc, test_row_cache_generation);
+	tcase_add_test(tc, test_row_cache_row_count);
+	tcase_add_test(tc, test_row_cache_reset);
+	tcase_add_test(tc, test_row_cache_seek);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("shared change numbers");
+	tcase_add_checked_fixture(tc, change_number_setup, change_number_teardown);
+	tcase_add_test(tc, test_change_number_shared);
+	tcase_add_test(tc, test_change_number_owner);
+	tcase_add_test(tc, test_change_number_outside_rop);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
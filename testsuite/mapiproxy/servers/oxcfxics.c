@@ -0,0 +1,172 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "mapiproxy/servers/default/emsmdb/dcesrv_exchange_emsmdb.h"
+
+#define	BOUNDARY_COUNT	10000
+
+/* Global test variables */
+static TALLOC_CTX			*mem_ctx;
+static struct emsmdbp_stream_segments	*segments;
+
+
+/* Deterministic pseudo-random numbers, so failures can be replayed */
+static uint32_t next_random(uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 16) & 0x7fff;
+}
+
+/* The response size the cutmark array, made of (min_size, offset)
+   pairs ended by (0, 0xffffffff), gave before the segment index */
+static uint32_t cutmarks_slice(const uint32_t *cutmarks, uint32_t *mark_idx, size_t position, uint32_t request_buffer_size)
+{
+	uint32_t	buffer_size, min_value_buffer, idx, max_cutmark;
+
+	buffer_size = request_buffer_size;
+
+	idx = *mark_idx;
+	max_cutmark = position + request_buffer_size;
+	while (cutmarks[idx] != 0xffffffff && cutmarks[idx] < max_cutmark) {
+		buffer_size = cutmarks[idx] - position;
+		idx += 2;
+	}
+	if (buffer_size < request_buffer_size && cutmarks[idx] != 0xffffffff) {
+		min_value_buffer = cutmarks[idx-1];
+		if (min_value_buffer && (request_buffer_size - buffer_size > min_value_buffer)) {
+			buffer_size = request_buffer_size;
+		}
+	}
+	*mark_idx = idx;
+
+	return buffer_size;
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_segments_cut) {
+	oxcfxics_stream_segment_push(segments, 0, 100);
+	oxcfxics_stream_segment_push(segments, 0, 250);
+	oxcfxics_stream_segment_push(segments, 0, 400);
+
+	/* Each response ends on the last boundary that fits */
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 0, 300), 250);
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 250, 300), 150);
+
+	/* Past the last boundary the request is served in full */
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 400, 300), 300);
+	ck_assert_int_eq(segments->next, 3);
+
+	/* A stream without index is cut anywhere */
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(NULL, 400, 300), 300);
+} END_TEST
+
+START_TEST (test_segments_split) {
+	oxcfxics_stream_segment_push(segments, 0, 100);
+	oxcfxics_stream_segment_push(segments, 50, 1000);
+
+	/* The value ending at 1000 may be split: more than 50 bytes of
+	   it fit in the response */
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 0, 300), 300);
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 300, 300), 300);
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 600, 300), 300);
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 900, 300), 100);
+} END_TEST
+
+START_TEST (test_segments_no_split) {
+	oxcfxics_stream_segment_push(segments, 0, 100);
+	oxcfxics_stream_segment_push(segments, 250, 1000);
+
+	/* Too little of the value fits: the response ends before it */
+	ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, 0, 300), 100);
+	ck_assert_int_eq(segments->next, 1);
+} END_TEST
+
+START_TEST (test_segments_cutmarks) {
+	uint32_t	*cutmarks;
+	uint32_t	mark_idx = 1;
+	uint32_t	seed = 0x4f43;
+	uint32_t	offset = 0;
+	uint32_t	min_size;
+	uint32_t	request_size;
+	uint32_t	expected;
+	uint32_t	i;
+	size_t		position;
+
+	cutmarks = talloc_array(mem_ctx, uint32_t, 2 * BOUNDARY_COUNT + 2);
+	ck_assert(cutmarks != NULL);
+	for (i = 0; i < BOUNDARY_COUNT; i++) {
+		offset += 1 + next_random(&seed) % 600;
+		min_size = (next_random(&seed) % 3) ? 0 : 1 + next_random(&seed) % 200;
+		oxcfxics_stream_segment_push(segments, min_size, offset);
+		cutmarks[2 * i] = min_size;
+		cutmarks[2 * i + 1] = offset;
+	}
+	cutmarks[2 * i] = 0;
+	cutmarks[2 * i + 1] = 0xffffffff;
+	ck_assert_int_eq(segments->count, BOUNDARY_COUNT);
+
+	/* Clients send GetBuffer with varying sizes: every response has
+	   the size the cutmarks gave */
+	position = 0;
+	while (position < offset) {
+		request_size = 0x100 + next_random(&seed) % 0x7f00;
+		expected = cutmarks_slice(cutmarks, &mark_idx, position, request_size);
+		ck_assert_int_eq(oxcfxics_stream_segments_slice(segments, position, request_size), expected);
+		ck_assert_int_eq(segments->next, (mark_idx - 1) / 2);
+		position += expected;
+	}
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void segments_setup(void)
+{
+	mem_ctx = talloc_named(NULL, 0, "segments_setup");
+	ck_assert(mem_ctx != NULL);
+
+	segments = oxcfxics_stream_segments_init(mem_ctx);
+	ck_assert(segments != NULL);
+}
+
+static void segments_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_servers_oxcfxics_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("mapiproxy/servers/oxcfxics");
+
+	tc = tcase_create("stream segments");
+	tcase_add_checked_fixture(tc, segments_setup, segments_teardown);
+	tcase_add_test(tc, test_segments_cut);
+	tcase_add_test(tc, test_segments_split);
+	tcase_add_test(tc, test_segments_no_split);
+	tcase_add_test(tc, test_segments_cutmarks);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -0,0 +1,313 @@
+/*
+   OpenChange Unit Testing
+
+   OpenChange Project
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "testsuite.h"
+#include "emsmdbp_common.h"
+
+#define	TABLE_ROW_COUNT	64
+
+/* Global test variables */
+static TALLOC_CTX			*mem_ctx;
+static struct emsmdbp_test_context	*ctx;
+static struct emsmdbp_object_table	*table;
+static struct emsmdbp_test_row		rows[TABLE_ROW_COUNT + 3];
+
+static const enum MAPITAGS		columns[] = {
+	PidTagMid,
+	PidTagMessageSize,
+	PidTagSubject,
+	PidTagInstanceKey
+};
+
+
+static void size_restriction(struct mapi_SRestriction *res, uint8_t relop, uint32_t size)
+{
+	memset(res, 0, sizeof (struct mapi_SRestriction));
+	res->rt = RES_PROPERTY;
+	res->res.resProperty.relop = relop;
+	res->res.resProperty.ulPropTag = PidTagMessageSize;
+	res->res.resProperty.lpProp.ulPropTag = PidTagMessageSize;
+	res->res.resProperty.lpProp.value.l = size;
+}
+
+static void subject_restriction(struct mapi_SRestriction *res, uint8_t relop, const char *subject)
+{
+	memset(res, 0, sizeof (struct mapi_SRestriction));
+	res->rt = RES_PROPERTY;
+	res->res.resProperty.relop = relop;
+	res->res.resProperty.ulPropTag = PidTagSubject;
+	res->res.resProperty.lpProp.ulPropTag = PidTagSubject;
+	res->res.resProperty.lpProp.value.lpszW = subject;
+}
+
+static void find_row(struct mapi_SRestriction *res, uint8_t origin, struct SBinary_short *bookmark,
+		     struct EcDoRpc_MAPI_REPL *repl)
+{
+	struct EcDoRpc_MAPI_REQ	req;
+	uint32_t		handles[1] = { ctx->table_handle };
+	uint16_t		size = 0;
+
+	memset(&req, 0, sizeof (req));
+	memset(repl, 0, sizeof (struct EcDoRpc_MAPI_REPL));
+	req.opnum = op_MAPI_FindRow;
+	req.u.mapi_FindRow.ulFlags = DIR_FORWARD;
+	req.u.mapi_FindRow.res = *res;
+	req.u.mapi_FindRow.origin = origin;
+	if (bookmark) {
+		req.u.mapi_FindRow.bookmark = *bookmark;
+	}
+
+	ctx->table->get_row_calls = 0;
+	ck_assert_int_eq(EcDoRpc_RopFindRow(mem_ctx, ctx->emsmdbp_ctx, &req, repl, handles, &size), MAPI_E_SUCCESS);
+}
+
+static void create_bookmark(uint32_t row_id, struct SBinary_short *bookmark)
+{
+	struct EcDoRpc_MAPI_REQ		req;
+	struct EcDoRpc_MAPI_REPL	repl;
+	uint32_t			handles[1] = { ctx->table_handle };
+	uint16_t			size = 0;
+
+	memset(&req, 0, sizeof (req));
+	memset(&repl, 0, sizeof (repl));
+	req.opnum = op_MAPI_CreateBookmark;
+
+	table->numerator = row_id;
+	ck_assert_int_eq(EcDoRpc_RopCreateBookmark(mem_ctx, ctx->emsmdbp_ctx, &req, &repl, handles, &size), MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl.error_code, MAPI_E_SUCCESS);
+	*bookmark = repl.u.mapi_CreateBookmark.bookmark;
+}
+
+static void seek_row_bookmark(struct SBinary_short *bookmark, struct EcDoRpc_MAPI_REPL *repl)
+{
+	struct EcDoRpc_MAPI_REQ	req;
+	uint32_t		handles[1] = { ctx->table_handle };
+	uint16_t		size = 0;
+
+	memset(&req, 0, sizeof (req));
+	memset(repl, 0, sizeof (struct EcDoRpc_MAPI_REPL));
+	req.opnum = op_MAPI_SeekRowBookmark;
+	req.u.mapi_SeekRowBookmark.Bookmark = *bookmark;
+
+	ck_assert_int_eq(EcDoRpc_RopSeekRowBookmark(mem_ctx, ctx->emsmdbp_ctx, &req, repl, handles, &size), MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl->error_code, MAPI_E_SUCCESS);
+}
+
+/* Insert rows before the first one, as a backend would on new mail */
+static void insert_rows(uint32_t count)
+{
+	uint32_t	i;
+
+	memmove(&rows[count], &rows[0], TABLE_ROW_COUNT * sizeof (struct emsmdbp_test_row));
+	for (i = 0; i < count; i++) {
+		rows[i].mid = 0x100 + i;
+		rows[i].size = 0;
+		rows[i].subject = "new";
+	}
+	emsmdbp_test_table_set_rows(ctx, rows, TABLE_ROW_COUNT + count);
+}
+
+// v Unit test ----------------------------------------------------------------
+
+START_TEST (test_findrow_sorted_bisect) {
+	struct mapi_SRestriction	res;
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	table->sort_proptag = PidTagMessageSize;
+	table->sort_order = TABLE_SORT_ASCEND;
+
+	size_restriction(&res, RELOP_GE, 5000);
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(repl.error_code, MAPI_E_SUCCESS);
+	ck_assert_int_eq(repl.u.mapi_FindRow.HasRowData, 1);
+	ck_assert_int_eq(table->numerator, 50);
+
+	/* The sign checks of both ends, the probes and the matching row,
+	   instead of the 51 rows up to it */
+	ck_assert_int_le(ctx->table->get_row_calls, 2 + 6 + 1);
+
+	/* A strict bound skips the rows holding the value */
+	size_restriction(&res, RELOP_GT, 4900);
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(repl.u.mapi_FindRow.HasRowData, 1);
+	ck_assert_int_eq(table->numerator, 50);
+} END_TEST
+
+START_TEST (test_findrow_sorted_signed) {
+	struct mapi_SRestriction	res;
+	struct EcDoRpc_MAPI_REPL	repl;
+	uint32_t			i;
+	uint32_t			expected;
+
+	/* Sorted on the signed value: the first rows are negative */
+	for (i = 0; i < TABLE_ROW_COUNT; i++) {
+		rows[i].size = (uint32_t)((int32_t) i * 100 - 1000);
+	}
+	size_restriction(&res, RELOP_GE, 500);
+
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(repl.u.mapi_FindRow.HasRowData, 1);
+	expected = table->numerator;
+
+	/* The sorted table finds the row the scan finds */
+	table->sort_proptag = PidTagMessageSize;
+	table->sort_order = TABLE_SORT_ASCEND;
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(repl.u.mapi_FindRow.HasRowData, 1);
+	ck_assert_int_eq(table->numerator, expected);
+} END_TEST
+
+START_TEST (test_findrow_sorted_string) {
+	struct mapi_SRestriction	res;
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	table->sort_proptag = PidTagSubject;
+	table->sort_order = TABLE_SORT_ASCEND;
+
+	/* Strings are sorted with the backend collation: rows are scanned */
+	subject_restriction(&res, RELOP_EQ, "subject 50");
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(repl.error_code, MAPI_E_SUCCESS);
+	ck_assert_int_eq(table->numerator, 50);
+	ck_assert_int_eq(ctx->table->get_row_calls, 51);
+} END_TEST
+
+START_TEST (test_findrow_unsorted) {
+	struct mapi_SRestriction	res;
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	size_restriction(&res, RELOP_GE, 5000);
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(table->numerator, 50);
+	ck_assert_int_eq(ctx->table->get_row_calls, 51);
+
+	size_restriction(&res, RELOP_GT, 100000);
+	find_row(&res, BOOKMARK_BEGINNING, NULL, &repl);
+	ck_assert_int_eq(repl.error_code, MAPI_E_NOT_FOUND);
+} END_TEST
+
+START_TEST (test_bookmark_follows_row) {
+	struct SBinary_short		bookmark;
+	struct mapi_SRestriction	res;
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	create_bookmark(20, &bookmark);
+
+	/* New rows were sorted before the bookmarked one */
+	insert_rows(3);
+	seek_row_bookmark(&bookmark, &repl);
+	ck_assert_int_eq(repl.u.mapi_SeekRowBookmark.RowNoLongerVisible, 0);
+	ck_assert_int_eq(table->numerator, 23);
+
+	size_restriction(&res, RELOP_GE, 0);
+	find_row(&res, BOOKMARK_USER, &bookmark, &repl);
+	ck_assert_int_eq(repl.u.mapi_FindRow.RowNoLongerVisible, 0);
+	ck_assert_int_eq(table->numerator, 23);
+} END_TEST
+
+START_TEST (test_bookmark_removed_row) {
+	struct SBinary_short		bookmark;
+	struct mapi_SRestriction	res;
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	create_bookmark(20, &bookmark);
+
+	/* The bookmarked row was deleted: the next row took its place */
+	memmove(&rows[20], &rows[21], (TABLE_ROW_COUNT - 21) * sizeof (struct emsmdbp_test_row));
+	emsmdbp_test_table_set_rows(ctx, rows, TABLE_ROW_COUNT - 1);
+
+	seek_row_bookmark(&bookmark, &repl);
+	ck_assert_int_eq(repl.u.mapi_SeekRowBookmark.RowNoLongerVisible, 1);
+	ck_assert_int_eq(table->numerator, 20);
+
+	size_restriction(&res, RELOP_GE, 0);
+	find_row(&res, BOOKMARK_USER, &bookmark, &repl);
+	ck_assert_int_eq(repl.u.mapi_FindRow.RowNoLongerVisible, 1);
+	ck_assert_int_eq(table->numerator, 20);
+} END_TEST
+
+START_TEST (test_bookmark_without_key) {
+	struct SBinary_short		bookmark;
+	struct EcDoRpc_MAPI_REPL	repl;
+
+	/* Without PidTagInstanceKey in the column set, the position is kept */
+	emsmdbp_test_table_set_columns(ctx, columns, 3);
+	create_bookmark(20, &bookmark);
+
+	insert_rows(3);
+	seek_row_bookmark(&bookmark, &repl);
+	ck_assert_int_eq(repl.u.mapi_SeekRowBookmark.RowNoLongerVisible, 0);
+	ck_assert_int_eq(table->numerator, 20);
+} END_TEST
+
+// ^ unit tests ---------------------------------------------------------------
+
+// v suite definition ---------------------------------------------------------
+
+static void oxctabl_setup(void)
+{
+	uint32_t	i;
+
+	mem_ctx = talloc_named(NULL, 0, "oxctabl_setup");
+	ck_assert(mem_ctx != NULL);
+
+	ctx = emsmdbp_test_context_init(mem_ctx);
+	table = ctx->table_object->object.table;
+
+	/* Sorted ascending on both the size and the subject */
+	memset(rows, 0, sizeof (rows));
+	for (i = 0; i < TABLE_ROW_COUNT; i++) {
+		rows[i].mid = 0x1000 + i;
+		rows[i].size = i * 100;
+		rows[i].subject = talloc_asprintf(mem_ctx, "subject %02u", i);
+		ck_assert(rows[i].subject != NULL);
+	}
+	emsmdbp_test_table_set_rows(ctx, rows, TABLE_ROW_COUNT);
+	emsmdbp_test_table_set_columns(ctx, columns, sizeof (columns) / sizeof (columns[0]));
+}
+
+static void oxctabl_teardown(void)
+{
+	talloc_free(mem_ctx);
+}
+
+Suite *mapiproxy_servers_oxctabl_suite(void)
+{
+	Suite	*s;
+	TCase	*tc;
+
+	s = suite_create("mapiproxy/servers/oxctabl");
+
+	tc = tcase_create("FindRow");
+	tcase_add_checked_fixture(tc, oxctabl_setup, oxctabl_teardown);
+	tcase_add_test(tc, test_findrow_sorted_bisect);
+	tcase_add_test(tc, test_findrow_sorted_signed);
+	tcase_add_test(tc, test_findrow_sorted_string);
+	tcase_add_test(tc, test_findrow_unsorted);
+	suite_add_tcase(s, tc);
+
+	tc = tcase_create("bookmarks");
+	tcase_add_checked_fixture(tc, oxctabl_setup, oxctabl_teardown);
+	tcase_add_test(tc, test_bookmark_follows_row);
+	tcase_add_test(tc, test_bookmark_removed_row);
+	tcase_add_test(tc, test_bookmark_without_key);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
@@ -244,6 +244,82 @@ START_TEST (test_create_schema) {
 
 } END_TEST
 
+START_TEST (test_connection_pool) {
+	const char		*connection_string;
+	struct mysql_pool_stats	stats;
+	MYSQL			*conn1 = NULL, *conn2 = NULL, *conn3 = NULL;
+	bool			ret;
+
+	connection_string = "mysql://"OC_TESTSUITE_MYSQL_USER":"OC_TESTSUITE_MYSQL_PASS
+			    "@"OC_TESTSUITE_MYSQL_HOST"/"OC_TESTSUITE_MYSQL_DB;
+
+	/* Busy connections are not handed out twice while the pool can grow */
+	ck_assert(create_connection(connection_string, &conn1) != NULL);
+	ck_assert(create_connection(connection_string, &conn2) != NULL);
+	ck_assert(conn1 != conn2);
+	ck_assert(conn1 != conn && conn2 != conn);
+
+	/* Released connections are reused */
+	release_connection(conn2);
+	ck_assert(create_connection(connection_string, &conn3) != NULL);
+	ck_assert(conn3 == conn2);
+
+	ret = mysql_pool_get_stats(connection_string, &stats);
+	ck_assert(ret);
+	ck_assert_int_eq(stats.size, 3);
+	ck_assert_int_eq(stats.in_use, 3);
+	ck_assert_int_eq(stats.checkouts, 4);
+
+	release_connection(conn1);
+	release_connection(conn3);
+	ret = mysql_pool_get_stats(connection_string, &stats);
+	ck_assert(ret);
+	ck_assert_int_eq(stats.in_use, 1);
+
+	ck_assert(!mysql_pool_get_stats("mysql://unknown@localhost/db", &stats));
+} END_TEST
+
+START_TEST (test_prepared_statements) {
+	MYSQL_BIND		params[2];
+	unsigned long		name_len;
+	uint64_t		id = 42, values[2], affected = 0;
+	const char		*name = "it's a name";
+	const char		*s = NULL;
+	enum MYSQLRESULT	ret;
+
+	ck_assert(execute_query(conn, "CREATE TABLE IF NOT EXISTS stmt_test "
+				"(id BIGINT UNSIGNED, name VARCHAR(64))") == MYSQL_SUCCESS);
+
+	stmt_bind_uint64(&params[0], &id);
+	stmt_bind_string(&params[1], name, &name_len);
+	ret = stmt_execute(conn, 0, "INSERT INTO stmt_test VALUES (?, ?)", params, &affected);
+	ck_assert_int_eq(ret, MYSQL_SUCCESS);
+	ck_assert_int_eq(affected, 1);
+
+	/* Values are bound as is, no escaping is needed */
+	stmt_bind_string(&params[0], name, &name_len);
+	ret = stmt_select_first_uints(conn, 1, "SELECT id, id + 1 FROM stmt_test WHERE name = ?",
+				      params, 2, values);
+	ck_assert_int_eq(ret, MYSQL_SUCCESS);
+	ck_assert_int_eq(values[0], 42);
+	ck_assert_int_eq(values[1], 43);
+
+	/* Cached statements are executed again with new parameters */
+	id = 0;
+	stmt_bind_uint64(&params[0], &id);
+	ret = stmt_select_first_string(mem_ctx, conn, 2, "SELECT name FROM stmt_test WHERE id = ?",
+				       params, &s);
+	ck_assert_int_eq(ret, MYSQL_NOT_FOUND);
+
+	id = 42;
+	ret = stmt_select_first_string(mem_ctx, conn, 2, "SELECT name FROM stmt_test WHERE id = ?",
+				       params, &s);
+	ck_assert_int_eq(ret, MYSQL_SUCCESS);
+	ck_assert_str_eq(s, name);
+
+	ck_assert(execute_query(conn, "DROP TABLE stmt_test") == MYSQL_SUCCESS);
+} END_TEST
+
 // ^ unit tests ---------------------------------------------------------------
 
 // v suite definition ---------------------------------------------------------
@@ -285,6 +361,8 @@ Suite *mapiproxy_util_mysql_suite(void)
 	tcase_add_test(tc, test_parse_connection_string_fail);
 	tcase_add_test(tc, test_parse_connection_string_success);
 	tcase_add_test(tc, test_create_schema);
+	tcase_add_test(tc, test_connection_pool);
+	tcase_add_test(tc, test_prepared_statements);
 
 	suite_add_tcase(s, tc);
 
@@ -23,9 +23,43 @@
 #include "testsuite_common.h"
 #include "mapiproxy/util/schema_migration.c"
 
+/* Latest migration of each schema */
+#define	OPENCHANGEDB_SCHEMA_VERSION	4
+#define	INDEXING_SCHEMA_VERSION		3
+#define	NAMED_PROPERTIES_SCHEMA_VERSION	2
+
 /* Global test variables */
 static MYSQL *conn;
 
+
+static uint64_t schema_version(const char *app)
+{
+	char		*sql;
+	uint64_t	version = 0;
+
+	sql = talloc_asprintf(NULL, "SELECT MAX(version) FROM migrations WHERE app = '%s'", app);
+	ck_assert(sql != NULL);
+	ck_assert_int_eq(select_first_uint(conn, sql, &version), MYSQL_SUCCESS);
+	talloc_free(sql);
+
+	return version;
+}
+
+static bool index_exists(const char *table, const char *index)
+{
+	char		*sql;
+	uint64_t	count = 0;
+
+	sql = talloc_asprintf(NULL, "SELECT COUNT(*) FROM information_schema.STATISTICS "
+			      "WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = '%s' AND INDEX_NAME = '%s'",
+			      table, index);
+	ck_assert(sql != NULL);
+	ck_assert_int_eq(select_first_uint(conn, sql, &count), MYSQL_SUCCESS);
+	talloc_free(sql);
+
+	return count > 0;
+}
+
 // v Unit test ----------------------------------------------------------------
 
 START_TEST (test_migrate_openchangedb_schema) {
@@ -37,6 +71,15 @@ START_TEST (test_migrate_openchangedb_schema) {
 
 	ret = migrate_openchangedb_schema(connection_string);
 	ck_assert_int_eq(ret, 0);
+	ck_assert_int_eq(schema_version("openchangedb"), OPENCHANGEDB_SCHEMA_VERSION);
+	ck_assert(table_exists(conn, "folder_counts"));
+	ck_assert(table_exists(conn, "folder_change_numbers"));
+	ck_assert(table_exists(conn, "folder_message_counts"));
+
+	/* Migrating an up to date schema changes nothing */
+	ret = migrate_openchangedb_schema(connection_string);
+	ck_assert_int_eq(ret, 0);
+	ck_assert_int_eq(schema_version("openchangedb"), OPENCHANGEDB_SCHEMA_VERSION);
 
 } END_TEST
 
@@ -49,6 +92,17 @@ START_TEST (test_migrate_indexing_schema) {
 
 	ret = migrate_indexing_schema(connection_string);
 	ck_assert_int_eq(ret, 0);
+	ck_assert_int_eq(schema_version("indexing"), INDEXING_SCHEMA_VERSION);
+	ck_assert(index_exists("mapistore_indexing", "mapistore_indexing_username_idx"));
+	ck_assert(index_exists("mapistore_indexing", "mapistore_indexing_username_url_idx"));
+	ck_assert(index_exists("mapistore_indexing", "mapistore_indexing_username_fmid_idx"));
+	ck_assert(index_exists("mapistore_indexes", "mapistore_indexes_username_idx"));
+	ck_assert(table_exists(conn, "mapistore_replica_mapping"));
+
+	/* Migrating an up to date schema changes nothing */
+	ret = migrate_indexing_schema(connection_string);
+	ck_assert_int_eq(ret, 0);
+	ck_assert_int_eq(schema_version("indexing"), INDEXING_SCHEMA_VERSION);
 
 } END_TEST
 
@@ -61,6 +115,7 @@ START_TEST (test_migrate_named_properties_schema) {
 
 	ret = migrate_named_properties_schema(connection_string);
 	ck_assert_int_eq(ret, 0);
+	ck_assert_int_eq(schema_version("named_properties"), NAMED_PROPERTIES_SCHEMA_VERSION);
 
 } END_TEST
 
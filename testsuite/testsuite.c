@@ -102,22 +102,56 @@ int main(int argc, const char *argv[])
 	/* libmapi */
 	srunner_add_suite(sr, libmapi_property_suite());
 	srunner_add_suite(sr, libmapi_idset_suite());
+	srunner_add_suite(sr, libmapi_nameid_suite());
+	srunner_add_suite(sr, libmapi_oc_log_suite());
+	srunner_add_suite(sr, libmapi_lzxpress_suite());
+	srunner_add_suite(sr, libmapi_lzfu_suite());
+	srunner_add_suite(sr, libmapi_fxparser_suite());
+	srunner_add_suite(sr, libmapi_ndr_mapi_suite());
+	srunner_add_suite(sr, libmapi_object_suite());
+	srunner_add_suite(sr, libmapi_cache_suite());
+	srunner_add_suite(sr, libmapi_utf16_suite());
 	/* libmapiproxy */
 	srunner_add_suite(sr, mapiproxy_openchangedb_mysql_suite());
 	srunner_add_suite(sr, mapiproxy_openchangedb_ldb_suite());
 	srunner_add_suite(sr, mapiproxy_openchangedb_multitenancy_mysql_suite());
 	srunner_add_suite(sr, mapiproxy_openchangedb_logger_suite());
+	srunner_add_suite(sr, mapiproxy_restriction_suite());
+	srunner_add_suite(sr, mapiproxy_dispatch_suite());
+	srunner_add_suite(sr, mapiproxy_shard_suite());
+	srunner_add_suite(sr, mapiproxy_rules_suite());
+	srunner_add_suite(sr, mapiproxy_mapi_handles_suite());
+	srunner_add_suite(sr, mapiproxy_stats_suite());
+	/* libmapiserver */
+	srunner_add_suite(sr, libmapiserver_oxcnotif_suite());
+	srunner_add_suite(sr, libmapiserver_oxcprpt_suite());
 	/* libmapistore */
 	srunner_add_suite(sr, mapistore_namedprops_suite());
 	srunner_add_suite(sr, mapistore_namedprops_mysql_suite());
 	srunner_add_suite(sr, mapistore_namedprops_tdb_suite());
 	srunner_add_suite(sr, mapistore_indexing_mysql_suite());
 	srunner_add_suite(sr, mapistore_indexing_tdb_suite());
+	srunner_add_suite(sr, mapistore_replica_mapping_tdb_suite());
+	srunner_add_suite(sr, mapistore_freebusy_suite());
+	srunner_add_suite(sr, mapistore_content_index_suite());
+	srunner_add_suite(sr, mapistore_tombstones_suite());
+	srunner_add_suite(sr, mapistore_attachments_suite());
+	srunner_add_suite(sr, mapistore_conversations_suite());
+	srunner_add_suite(sr, mapistore_profile_suite());
+	srunner_add_suite(sr, mapistore_backend_threads_suite());
+	srunner_add_suite(sr, mapistore_context_pool_suite());
 	srunner_add_suite(sr, mapistore_notification_suite());
 	/* mapiproxy */
 	srunner_add_suite(sr, mapiproxy_util_mysql_suite());
 	srunner_add_suite(sr, mapiproxy_util_schema_migration_suite());
 
+	srunner_add_suite(sr, mapiproxy_servers_emsmdbp_object_suite());
+	srunner_add_suite(sr, mapiproxy_servers_oxctabl_suite());
+	srunner_add_suite(sr, mapiproxy_servers_emsmdbp_category_suite());
+	srunner_add_suite(sr, mapiproxy_servers_emsmdbp_idle_suite());
+	srunner_add_suite(sr, mapiproxy_servers_emsabp_snapshot_suite());
+	srunner_add_suite(sr, mapiproxy_servers_oxcfxics_suite());
+
 	srunner_run_all(sr, CK_ENV);
 	nf = srunner_ntests_failed(sr);
 	srunner_free(sr);
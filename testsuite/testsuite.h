@@ -46,22 +46,56 @@ __BEGIN_DECLS
 /* libmapi */
 Suite *libmapi_property_suite(void);
 Suite *libmapi_idset_suite(void);
+Suite *libmapi_nameid_suite(void);
+Suite *libmapi_oc_log_suite(void);
+Suite *libmapi_lzxpress_suite(void);
+Suite *libmapi_lzfu_suite(void);
+Suite *libmapi_fxparser_suite(void);
+Suite *libmapi_ndr_mapi_suite(void);
+Suite *libmapi_object_suite(void);
+Suite *libmapi_cache_suite(void);
+Suite *libmapi_utf16_suite(void);
 /* libmapiproxy */
 Suite *mapiproxy_openchangedb_mysql_suite(void);
 Suite *mapiproxy_openchangedb_ldb_suite(void);
 Suite *mapiproxy_openchangedb_multitenancy_mysql_suite(void);
 Suite *mapiproxy_openchangedb_logger_suite(void);
+Suite *mapiproxy_restriction_suite(void);
+Suite *mapiproxy_dispatch_suite(void);
+Suite *mapiproxy_shard_suite(void);
+Suite *mapiproxy_rules_suite(void);
+Suite *mapiproxy_mapi_handles_suite(void);
+Suite *mapiproxy_stats_suite(void);
+/* libmapiserver */
+Suite *libmapiserver_oxcnotif_suite(void);
+Suite *libmapiserver_oxcprpt_suite(void);
 /* libmapistore */
 Suite *mapistore_namedprops_suite(void);
 Suite *mapistore_namedprops_mysql_suite(void);
 Suite *mapistore_namedprops_tdb_suite(void);
 Suite *mapistore_indexing_mysql_suite(void);
 Suite *mapistore_indexing_tdb_suite(void);
+Suite *mapistore_replica_mapping_tdb_suite(void);
+Suite *mapistore_freebusy_suite(void);
+Suite *mapistore_content_index_suite(void);
+Suite *mapistore_tombstones_suite(void);
+Suite *mapistore_attachments_suite(void);
+Suite *mapistore_conversations_suite(void);
+Suite *mapistore_profile_suite(void);
+Suite *mapistore_backend_threads_suite(void);
+Suite *mapistore_context_pool_suite(void);
 Suite *mapistore_notification_suite(void);
 /* mapiproxy */
 Suite *mapiproxy_util_mysql_suite(void);
 Suite *mapiproxy_util_schema_migration_suite(void);
 
+Suite *mapiproxy_servers_emsmdbp_object_suite(void);
+Suite *mapiproxy_servers_oxctabl_suite(void);
+Suite *mapiproxy_servers_emsmdbp_category_suite(void);
+Suite *mapiproxy_servers_emsmdbp_idle_suite(void);
+Suite *mapiproxy_servers_emsabp_snapshot_suite(void);
+Suite *mapiproxy_servers_oxcfxics_suite(void);
+
 __END_DECLS
 
 #endif /*! __TESTSUITE_H__ */
@@ -24,16 +24,9 @@
 
 #define OPENCHANGEDB_MYSQL_SCHEMA_PATH "setup/openchangedb"
 
-void initialize_mysql_with_file(TALLOC_CTX *mem_ctx, const char *sql_file_path,
-				struct openchangedb_context **oc_ctx)
+void initialize_mysql(TALLOC_CTX *mem_ctx, struct openchangedb_context **oc_ctx)
 {
 	const char		*database;
-	FILE			*f;
-	long int		sql_size = 0;
-	size_t			bytes_read = 0;
-	char			*sql = NULL, *insert = NULL;
-	bool			inserts_to_execute;
-	MYSQL			*conn;
 	struct loadparm_context	*lp_ctx;
 	enum MAPISTATUS		retval;
 	const char		*mysql_pass = getenv("OC_MYSQL_PASS");
@@ -54,12 +47,28 @@ void initialize_mysql_with_file(TALLOC_CTX *mem_ctx, const char *sql_file_path,
 	ck_assert(lp_ctx != NULL);
 
 	ck_assert((lpcfg_set_cmdline(lp_ctx, "mapiproxy:openchangedb", database) == true));
+	/* Small pages so tables span several of them */
+	ck_assert((lpcfg_set_cmdline(lp_ctx, "mapiproxy:openchangedb_table_page_size", "4") == true));
 	retval = openchangedb_mysql_initialize(mem_ctx, lp_ctx, oc_ctx);
 
 	if (retval != MAPI_E_SUCCESS) {
 		fprintf(stderr, "Error initializing openchangedb %d\n", retval);
 		ck_abort();
 	}
+}
+
+void initialize_mysql_with_file(TALLOC_CTX *mem_ctx, const char *sql_file_path,
+				struct openchangedb_context **oc_ctx)
+{
+	FILE			*f;
+	long int		sql_size = 0;
+	size_t			bytes_read = 0;
+	char			*sql = NULL, *insert = NULL;
+	bool			inserts_to_execute;
+	MYSQL			*conn;
+	enum MAPISTATUS		retval;
+
+	initialize_mysql(mem_ctx, oc_ctx);
 
 	// Populate database with sample data
 	conn = (*oc_ctx)->data;
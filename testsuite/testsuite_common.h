@@ -36,6 +36,7 @@
 #define NEXT_CHANGE_NUMBER		402
 
 
+void initialize_mysql(TALLOC_CTX *, struct openchangedb_context **);
 void initialize_mysql_with_file(TALLOC_CTX *, const char *, struct openchangedb_context **);
 void drop_mysql_database(MYSQL *, const char *);
 
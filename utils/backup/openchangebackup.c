@@ -233,6 +233,189 @@ uint32_t ocb_record_add_property(struct ocb_context *ocb_ctx,
 	return 0;
 }
 
+/**
+ * Content digest of attachment data: FNV-1a over the bytes
+ */
+static uint64_t ocb_blob_digest(const struct SBinary_short *bin)
+{
+	uint64_t	digest = 14695981039346656037ULL;
+	uint32_t	i;
+
+	for (i = 0; i < bin->cb; i++) {
+		digest = (digest ^ bin->lpb[i]) * 1099511628211ULL;
+	}
+
+	return digest;
+}
+
+/**
+ * Store binary data once under ocb_ctx->blobdn and reference it from
+ * the current record. Records holding the same content share the
+ * same blob, the digest is only used to find candidates and the
+ * content is always compared.
+ *
+ * Returns -1 when the data could not be shared, the caller should
+ * then add it to the record with ocb_record_add_property
+ */
+uint32_t ocb_record_add_blob(struct ocb_context *ocb_ctx,
+			     struct mapi_SPropValue *lpProp)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct ldb_context	*ldb_ctx;
+	struct ldb_result	*res;
+	struct ldb_message	*msg;
+	struct ldb_dn		*dn;
+	const struct ldb_val	*stored;
+	struct ldb_val		val;
+	const char * const	attrs[] = { "data", NULL };
+	const struct SBinary_short *bin;
+	uint64_t		digest;
+	uint32_t		probe;
+	char			*key;
+	bool			retry = true;
+	int			ret;
+
+	/* sanity checks */
+	OCB_RETVAL_IF(!ocb_ctx, "Subsystem not initialized", NULL);
+	OCB_RETVAL_IF(!ocb_ctx->ldb_ctx, "LDB context not initialized", NULL);
+	OCB_RETVAL_IF(!ocb_ctx->msg, "Message not initialized", NULL);
+	OCB_RETVAL_IF(!ocb_ctx->blobdn, "Blob container not set", NULL);
+	OCB_RETVAL_IF((lpProp->ulPropTag & 0xFFFF) != PT_BINARY, "Not a binary property", NULL);
+
+	bin = &lpProp->value.bin;
+	if (!bin->cb) return -1;
+
+	mem_ctx = talloc_new(ocb_ctx->msg);
+	ldb_ctx = ocb_ctx->ldb_ctx;
+	digest = ocb_blob_digest(bin);
+	val.data = bin->lpb;
+	val.length = bin->cb;
+
+	for (probe = 0; probe < OCB_BLOB_PROBES; probe++) {
+		key = talloc_asprintf(mem_ctx, "%.16"PRIX64"%.8X%.2X", digest, bin->cb, probe);
+		dn = ldb_dn_new_fmt(mem_ctx, ldb_ctx, "cn=%s,%s", key, ocb_ctx->blobdn);
+		OCB_RETVAL_IF(!ldb_dn_validate(dn), "Invalid DN", mem_ctx);
+
+	lookup:
+		ret = ldb_search(ldb_ctx, mem_ctx, &res, dn, LDB_SCOPE_BASE, attrs, NULL);
+		if (ret == LDB_SUCCESS && res->count) {
+			stored = ldb_msg_find_ldb_val(res->msgs[0], "data");
+			if (!stored || ldb_val_equal_exact(stored, &val) != 1) {
+				/* digest collision, try the next key */
+				continue;
+			}
+		} else {
+			msg = ldb_msg_new(mem_ctx);
+			msg->dn = dn;
+			ldb_msg_add_string(msg, "cn", key);
+			ldb_msg_add_string(msg, "objectClass", OCB_OBJCLASS_BLOB);
+			ldb_msg_add_value(msg, "data", &val, NULL);
+			ret = ldb_add(ldb_ctx, msg);
+			if (ret != LDB_SUCCESS) {
+				/* another process may have stored it meanwhile */
+				OCB_RETVAL_IF(!retry, ldb_errstring(ldb_ctx), mem_ctx);
+				retry = false;
+				goto lookup;
+			}
+		}
+
+		ldb_msg_add_string(ocb_ctx->msg, OCB_BLOB_ATTR, talloc_steal(ocb_ctx->msg, key));
+		talloc_free(mem_ctx);
+		return 0;
+	}
+
+	talloc_free(mem_ctx);
+	return -1;
+}
+
+/**
+ * Delete a record, and the records below it when recursive is set
+ */
+uint32_t ocb_record_delete(struct ocb_context *ocb_ctx, const char *dn, bool recursive)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct ldb_context	*ldb_ctx;
+	struct ldb_result	*res;
+	struct ldb_dn		*basedn;
+	const char * const	attrs[] = { "cn", NULL };
+	int			comp_num;
+	int			max_depth;
+	int			depth;
+	uint32_t		i;
+	int			ret;
+
+	/* sanity checks */
+	OCB_RETVAL_IF(!ocb_ctx, "Subsystem not initialized", NULL);
+	OCB_RETVAL_IF(!ocb_ctx->ldb_ctx, "LDB context not initialized", NULL);
+	OCB_RETVAL_IF(!dn, "Not a valid DN", NULL);
+
+	mem_ctx = talloc_new(ocb_ctx);
+	ldb_ctx = ocb_ctx->ldb_ctx;
+
+	basedn = ldb_dn_new(mem_ctx, ldb_ctx, dn);
+	OCB_RETVAL_IF(!ldb_dn_validate(basedn), "Invalid DN", mem_ctx);
+
+	ret = ldb_search(ldb_ctx, mem_ctx, &res, basedn,
+			 recursive ? LDB_SCOPE_SUBTREE : LDB_SCOPE_BASE, attrs, NULL);
+	if (ret != LDB_SUCCESS || !res->count) {
+		talloc_free(mem_ctx);
+		return 0;
+	}
+
+	/* deepest records first */
+	comp_num = ldb_dn_get_comp_num(basedn);
+	max_depth = 0;
+	for (i = 0; i < res->count; i++) {
+		max_depth = MAX(max_depth, ldb_dn_get_comp_num(res->msgs[i]->dn) - comp_num);
+	}
+
+	ret = ldb_transaction_start(ldb_ctx);
+	OCB_RETVAL_IF(ret != LDB_SUCCESS, ldb_errstring(ldb_ctx), mem_ctx);
+	for (depth = max_depth; depth >= 0; depth--) {
+		for (i = 0; i < res->count; i++) {
+			if (ldb_dn_get_comp_num(res->msgs[i]->dn) - comp_num != depth) continue;
+			ret = ldb_delete(ldb_ctx, res->msgs[i]->dn);
+			if (ret != LDB_SUCCESS) {
+				OC_DEBUG(3, "LDB operation failed: %s", ldb_errstring(ldb_ctx));
+				ldb_transaction_cancel(ldb_ctx);
+				talloc_free(mem_ctx);
+				return -1;
+			}
+		}
+	}
+	ret = ldb_transaction_commit(ldb_ctx);
+	OCB_RETVAL_IF(ret != LDB_SUCCESS, ldb_errstring(ldb_ctx), mem_ctx);
+
+	talloc_free(mem_ctx);
+	return 0;
+}
+
+/**
+ * List the records of a given objectClass right below dn
+ */
+struct ldb_result *ocb_record_list(TALLOC_CTX *mem_ctx, struct ocb_context *ocb_ctx,
+				   const char *dn, const char *objclass)
+{
+	struct ldb_result	*res;
+	struct ldb_dn		*basedn;
+	const char * const	attrs[] = { "cn", NULL };
+	int			ret;
+
+	/* sanity checks */
+	OCB_RETVAL_IF_CODE(!ocb_ctx, "Subsystem not initialized", NULL, NULL);
+	OCB_RETVAL_IF_CODE(!ocb_ctx->ldb_ctx, "LDB context not initialized", NULL, NULL);
+
+	basedn = ldb_dn_new(mem_ctx, ocb_ctx->ldb_ctx, dn);
+	OCB_RETVAL_IF_CODE(!ldb_dn_validate(basedn), "Invalid DN", basedn, NULL);
+
+	ret = ldb_search(ocb_ctx->ldb_ctx, mem_ctx, &res, basedn, LDB_SCOPE_ONELEVEL, attrs,
+			 "(objectClass=%s)", objclass);
+	talloc_free(basedn);
+	OCB_RETVAL_IF_CODE(ret != LDB_SUCCESS, "LDB search failed", NULL, NULL);
+
+	return res;
+}
+
 /**
  * Retrieve UUID from Sbinary_short struct
  * Generally used to map PR_STORE_KEY to a string
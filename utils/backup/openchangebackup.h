@@ -43,6 +43,7 @@
 struct ocb_context {
 	struct ldb_context	*ldb_ctx;	/* ldb database context */
 	struct ldb_message	*msg;		/* pointer on record msg */
+	char			*blobdn;	/* parent of the shared attachment data */
 };
 
 /* Prototypes */
@@ -64,6 +65,9 @@ int			ocb_record_init(struct ocb_context *, const char *,
 					const char *, const char *, struct mapi_SPropValue_array *);
 uint32_t		ocb_record_commit(struct ocb_context *);
 uint32_t		ocb_record_add_property(struct ocb_context *, struct mapi_SPropValue *);
+uint32_t		ocb_record_add_blob(struct ocb_context *, struct mapi_SPropValue *);
+uint32_t		ocb_record_delete(struct ocb_context *, const char *, bool);
+struct ldb_result	*ocb_record_list(TALLOC_CTX *, struct ocb_context *, const char *, const char *);
 
 char			*get_record_uuid(TALLOC_CTX *, const struct SBinary_short *);
 char			*get_MAPI_uuid(TALLOC_CTX *, const struct SBinary_short *);
@@ -89,9 +93,14 @@ do {						\
 #define	DEFAULT_OCBCONF		"%s/.openchange/openchangebackup.conf"
 #define	DEFAULT_OCBDB		"%s/.openchange/openchangebackup_%s.ldb"
 
+/* Attachment data is stored once per content */
+#define	OCB_BLOB_ATTR		"blobReference"
+#define	OCB_BLOB_PROBES		4
+
 /* objectClass */
 #define	OCB_OBJCLASS_CONTAINER	"container"
 #define	OCB_OBJCLASS_MESSAGE	"message"
 #define	OCB_OBJCLASS_ATTACHMENT	"attachment"
+#define	OCB_OBJCLASS_BLOB	"blob"
 
 #endif /* __OPENCHANGEBACKUP_H__ */
@@ -29,9 +29,14 @@
 
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <time.h>
 
+/* directory of the per-folder ICS states, NULL for a full dump */
+static const char	*sync_dir = NULL;
+
 /**
  * write attachment to the database
  */
@@ -46,6 +51,11 @@ static enum MAPISTATUS mapidump_write_attachment(struct ocb_context *ocb_ctx,
 	ret = ocb_record_init(ocb_ctx, OCB_OBJCLASS_ATTACHMENT, contentdn, uuid, props);
 	if (ret == -1) return MAPI_E_SUCCESS;
 	for (i = 0; i < props->cValues; i++) {
+		/* identical attachments share their data */
+		if (props->lpProps[i].ulPropTag == PR_ATTACH_DATA_BIN &&
+		    ocb_record_add_blob(ocb_ctx, &props->lpProps[i]) == 0) {
+			continue;
+		}
 		ret = ocb_record_add_property(ocb_ctx, &props->lpProps[i]);
 	}
 	ret = ocb_record_commit(ocb_ctx);
@@ -159,6 +169,49 @@ static enum MAPISTATUS mapidump_walk_attachment(TALLOC_CTX *mem_ctx,
 	return MAPI_E_SUCCESS;
 }
 
+/**
+ * Write a message and its attachments to the database. With replace,
+ * the record of a previous run is removed first
+ */
+static enum MAPISTATUS mapidump_dump_message(TALLOC_CTX *mem_ctx,
+					     struct ocb_context *ocb_ctx,
+					     mapi_object_t *obj_message,
+					     const char *containerdn,
+					     bool replace)
+{
+	enum MAPISTATUS			retval;
+	struct mapi_SPropValue_array	props;
+	const struct SBinary_short     	*sbin;
+	const uint8_t			*has_attach;
+	char				*uuid;
+	char				*contentdn;
+
+	retval = GetPropsAll(obj_message, MAPI_UNICODE, &props);
+	MAPI_RETVAL_IF(retval, GetLastError(), NULL);
+
+	/* extract unique identifier from PR_SOURCE_KEY */
+	sbin = (const struct SBinary_short *)find_mapi_SPropValue_data(&props, PR_SOURCE_KEY);
+	uuid = get_MAPI_uuid(mem_ctx, sbin);
+	MAPI_RETVAL_IF(!uuid, MAPI_E_CORRUPT_DATA, NULL);
+	contentdn = talloc_asprintf(mem_ctx, "cn=%s,%s", uuid, containerdn);
+	if (replace) {
+		ocb_record_delete(ocb_ctx, contentdn, true);
+	}
+	mapidump_write_message(ocb_ctx, &props, contentdn, uuid);
+
+	/* If Message has attachments then process them */
+	has_attach = (const uint8_t *)find_mapi_SPropValue_data(&props, PR_HASATTACH);
+	if (has_attach && *has_attach) {
+		mapidump_walk_attachment(mem_ctx, ocb_ctx, obj_message, contentdn);
+	}
+
+	/* free allocated strings */
+	talloc_free(uuid);
+	talloc_free(contentdn);
+
+	return MAPI_E_SUCCESS;
+}
+
 /**
  * Retrieve all the content within a folder
  */
@@ -169,7 +222,6 @@ static enum MAPISTATUS mapidump_walk_content(TALLOC_CTX *mem_ctx,
 {
 	enum MAPISTATUS			retval;
 	struct SPropTagArray		*SPropTagArray;
-	struct mapi_SPropValue_array	props;
 	struct SRowSet			rowset;
 	mapi_object_t			obj_ctable;
 	mapi_object_t			obj_message;
@@ -177,10 +229,6 @@ static enum MAPISTATUS mapidump_walk_content(TALLOC_CTX *mem_ctx,
 	uint32_t			i;
 	const mapi_id_t			*fid;
 	const mapi_id_t			*mid;
-	char				*uuid;
-	const struct SBinary_short     	*sbin;
-	const uint8_t			*has_attach;
-	char				*contentdn;
 
 	/* Get Contents Table */
 	mapi_object_init(&obj_ctable);
@@ -206,24 +254,7 @@ static enum MAPISTATUS mapidump_walk_content(TALLOC_CTX *mem_ctx,
 			/* Open Message */
 			retval = OpenMessage(obj_folder, *fid, *mid, &obj_message, 0);
 			if (GetLastError() == MAPI_E_SUCCESS) {
-				retval = GetPropsAll(&obj_message, MAPI_UNICODE, &props);
-				if (GetLastError() == MAPI_E_SUCCESS) {
-					/* extract unique identifier from PR_SOURCE_KEY */
-					sbin = (const struct SBinary_short *)find_mapi_SPropValue_data(&props, PR_SOURCE_KEY);
-					uuid = get_MAPI_uuid(mem_ctx, sbin);
-					contentdn = talloc_asprintf(mem_ctx, "cn=%s,%s", uuid, containerdn);
-					mapidump_write_message(ocb_ctx, &props, contentdn, uuid);
-
-					/* If Message has attachments then process them */
-					has_attach = (const uint8_t *)find_mapi_SPropValue_data(&props, PR_HASATTACH);
-					if (has_attach && *has_attach) {
-						mapidump_walk_attachment(mem_ctx, ocb_ctx, &obj_message, contentdn);
-					}
-
-					/* free allocated strings */
-					talloc_free(uuid);
-					talloc_free(contentdn);
-				}
+				mapidump_dump_message(mem_ctx, ocb_ctx, &obj_message, containerdn, false);
 			}
 			mapi_object_release(&obj_message);
 		}
@@ -235,6 +266,88 @@ static enum MAPISTATUS mapidump_walk_content(TALLOC_CTX *mem_ctx,
 }
 
 
+/**
+ * Convert the unique ID of a message record back to its message ID
+ */
+static mapi_id_t mapidump_uuid_to_mid(const char *uuid, uint16_t replid)
+{
+	mapi_id_t	mid = 0;
+	unsigned int	byte;
+	int		i;
+
+	if (!uuid || strlen(uuid) != 12) return 0;
+	for (i = 0; i < 6; i++) {
+		if (sscanf(uuid + 2 * i, "%2X", &byte) != 1) return 0;
+		mid |= (mapi_id_t)byte << (16 + 8 * i);
+	}
+
+	return mid | replid;
+}
+
+
+/**
+ * Retrieve the content of a folder changed since the previous run and
+ * remove the messages deleted meanwhile. The ICS state of the folder
+ * is kept in sync_dir and only updated once the folder is done
+ */
+static enum MAPISTATUS mapidump_sync_content(TALLOC_CTX *mem_ctx,
+					     struct ocb_context *ocb_ctx,
+					     mapi_object_t *obj_folder,
+					     mapi_id_t folder_id,
+					     const char *containerdn,
+					     const char *uuid)
+{
+	enum MAPISTATUS			retval;
+	struct octool_sync		*sync;
+	struct ldb_result		*res;
+	mapi_object_t			obj_message;
+	mapi_id_t			mid;
+	char				*path;
+	uint32_t			i;
+
+	path = talloc_asprintf(mem_ctx, "%s/%s", sync_dir, uuid);
+	sync = octool_sync_load(mem_ctx, path);
+	if (!sync) {
+		talloc_free(path);
+		return MAPI_E_CORRUPT_DATA;
+	}
+
+	retval = octool_sync_contents(obj_folder, sync);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("octool_sync_contents", retval);
+		goto end;
+	}
+
+	if (sync->deleted_count) {
+		res = ocb_record_list(mem_ctx, ocb_ctx, containerdn, OCB_OBJCLASS_MESSAGE);
+		for (i = 0; res && i < res->count; i++) {
+			mid = mapidump_uuid_to_mid(ldb_msg_find_attr_as_string(res->msgs[i], "cn", NULL),
+						   folder_id & 0xFFFF);
+			if (mid && octool_sync_deleted(sync, mid)) {
+				ocb_record_delete(ocb_ctx, ldb_dn_get_linearized(res->msgs[i]->dn), true);
+			}
+		}
+		talloc_free(res);
+	}
+
+	for (i = 0; i < sync->changed_count; i++) {
+		mapi_object_init(&obj_message);
+		retval = OpenMessage(obj_folder, folder_id, sync->changed[i], &obj_message, 0);
+		if (retval == MAPI_E_SUCCESS) {
+			mapidump_dump_message(mem_ctx, ocb_ctx, &obj_message, containerdn, true);
+		}
+		mapi_object_release(&obj_message);
+	}
+
+	retval = octool_sync_save(sync, path) ? MAPI_E_SUCCESS : MAPI_E_CALL_FAILED;
+
+end:
+	talloc_free(sync);
+	talloc_free(path);
+	return retval;
+}
+
+
 /**
  * Recursively retrieve folders
  */
@@ -243,7 +356,9 @@ static enum MAPISTATUS mapidump_walk_container(TALLOC_CTX *mem_ctx,
 					       mapi_object_t *obj_parent,
 					       mapi_id_t folder_id,
 					       char *parentdn,
-					       int count)
+					       int count,
+					       unsigned int worker,
+					       unsigned int workers)
 {
 	enum MAPISTATUS			retval;
 	struct SPropTagArray		*SPropTagArray;
@@ -258,6 +373,8 @@ static enum MAPISTATUS mapidump_walk_container(TALLOC_CTX *mem_ctx,
 	const mapi_id_t			*fid;
 	uint32_t			rcount;
 	uint32_t			i;
+	uint32_t			position = 0;
+	bool				owner;
 	const struct SBinary_short	*sbin;
 
 	/* Open folder */
@@ -278,18 +395,32 @@ static enum MAPISTATUS mapidump_walk_container(TALLOC_CTX *mem_ctx,
 	if (parentdn == NULL && count == 0) {
 		parentdn = talloc_asprintf(mem_ctx, "cn=%s", 
 					   get_MAPI_store_guid(mem_ctx, sbin));
+		ocb_ctx->blobdn = talloc_asprintf(ocb_ctx, "cn=blobs,%s", parentdn);
 	}
 
 	containerdn = talloc_asprintf(mem_ctx, "cn=%s,%s", uuid, parentdn);
 
-	/* Write entry for container */
-	mapidump_write_container(ocb_ctx, &props, containerdn, uuid);
-	talloc_free(uuid);
+	/* With several workers, the first one owns the top folder and
+	   the workers share its subfolders */
+	owner = (count || worker == 0);
 
-	/* Get Contents Table if PR_CONTENT_COUNT >= 1 */
-	if (child_content && *child_content >= 1) {
-		retval = mapidump_walk_content(mem_ctx, ocb_ctx, &obj_folder, containerdn);
+	if (owner) {
+		/* Write entry for container, its properties are refreshed
+		   on each incremental run */
+		if (sync_dir) {
+			ocb_record_delete(ocb_ctx, containerdn, false);
+		}
+		mapidump_write_container(ocb_ctx, &props, containerdn, uuid);
+
+		if (sync_dir) {
+			retval = mapidump_sync_content(mem_ctx, ocb_ctx, &obj_folder, folder_id,
+						       containerdn, uuid);
+		} else if (child_content && *child_content >= 1) {
+			/* Get Contents Table if PR_CONTENT_COUNT >= 1 */
+			retval = mapidump_walk_content(mem_ctx, ocb_ctx, &obj_folder, containerdn);
+		}
 	}
+	talloc_free(uuid);
 
 	/* Get Container Table if PR_FOLDER_CHILD_COUNT >= 1 */
 
@@ -307,9 +438,10 @@ static enum MAPISTATUS mapidump_walk_container(TALLOC_CTX *mem_ctx,
 		MAPI_RETVAL_IF(retval, GetLastError(), NULL);
 
 		while ((retval = QueryRows(&obj_htable, rcount, TBL_ADVANCE, TBL_FORWARD_READ, &rowset) != MAPI_E_NOT_FOUND) && rowset.cRows) {
-			for (i = 0; i < rowset.cRows; i++) {
+			for (i = 0; i < rowset.cRows; i++, position++) {
+				if (!count && (position % workers) != worker) continue;
 				fid = (const uint64_t *)find_SPropValue_data(&rowset.aRow[i], PR_FID);
-				retval = mapidump_walk_container(mem_ctx, ocb_ctx, &obj_folder, *fid, containerdn, count + 1);
+				retval = mapidump_walk_container(mem_ctx, ocb_ctx, &obj_folder, *fid, containerdn, count + 1, 0, 1);
 			}
 		}
 	} 
@@ -326,7 +458,9 @@ static enum MAPISTATUS mapidump_walk_container(TALLOC_CTX *mem_ctx,
 
 static enum MAPISTATUS mapidump_walk(TALLOC_CTX *mem_ctx,
 					       struct ocb_context *ocb_ctx,
-					       mapi_object_t *obj_store)
+					       mapi_object_t *obj_store,
+					       unsigned int worker,
+					       unsigned int workers)
 {
 	enum MAPISTATUS			retval;
 	mapi_id_t			id_mailbox;
@@ -335,7 +469,147 @@ static enum MAPISTATUS mapidump_walk(TALLOC_CTX *mem_ctx,
 				  olFolderTopInformationStore);
 	MAPI_RETVAL_IF(retval, GetLastError(), NULL);
 
-	return mapidump_walk_container(mem_ctx, ocb_ctx, obj_store, id_mailbox, NULL, 0);
+	return mapidump_walk_container(mem_ctx, ocb_ctx, obj_store, id_mailbox, NULL, 0, worker, workers);
+}
+
+
+/*
+ * Options shared by the parent and the worker processes
+ */
+struct mapidump_options {
+	const char	*profdb;
+	const char	*profname;
+	const char	*password;
+	const char	*backupdb;
+	const char	*debug;
+	bool		dumpdata;
+};
+
+/*
+ * Initialize MAPI and log on the profile, exit on failure
+ */
+static struct mapi_session *logon(TALLOC_CTX *mem_ctx, const struct mapidump_options *opts,
+				  struct mapi_context **mapi_ctx)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_session	*session = NULL;
+	char			*profname;
+
+	/* Initialize MAPI subsystem */
+	retval = MAPIInitialize(mapi_ctx, opts->profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", GetLastError());
+		exit (1);
+	}
+
+	/* debug options */
+	SetMAPIDumpData(*mapi_ctx, opts->dumpdata);
+
+	if (opts->debug) {
+		SetMAPIDebugLevel(*mapi_ctx, atoi(opts->debug));
+	}
+
+	/* If no profile is specified try to load the default one from
+	 * the database 
+	 */
+	if (opts->profname) {
+		profname = talloc_strdup(mem_ctx, opts->profname);
+	} else {
+		retval = GetDefaultProfile(*mapi_ctx, &profname);
+		if (retval != MAPI_E_SUCCESS) {
+			mapi_errstr("GetDefaultProfile", GetLastError());
+			exit (1);
+		}
+	}
+
+	/* We only need to log on EMSMDB to backup Mailbox store or Public Folders */
+	retval = MapiLogonProvider(*mapi_ctx, &session, profname, opts->password, PROVIDER_ID_EMSMDB);
+	talloc_free(profname);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MapiLogonEx", GetLastError());
+		exit (1);
+	}
+
+	return session;
+}
+
+/*
+ * Back up the share of the mailbox assigned to worker
+ */
+static enum MAPISTATUS mapidump_backup(TALLOC_CTX *mem_ctx, const struct mapidump_options *opts,
+				       unsigned int worker, unsigned int workers)
+{
+	enum MAPISTATUS		retval;
+	struct ocb_context	*ocb_ctx = NULL;
+	struct mapi_context	*mapi_ctx;
+	struct mapi_session	*session;
+	mapi_object_t		obj_store;
+
+	/* Initialize OpenChange Backup subsystem */
+	if (!(ocb_ctx = ocb_init(mem_ctx, opts->backupdb))) {
+		return MAPI_E_CALL_FAILED;
+	}
+
+	session = logon(mem_ctx, opts, &mapi_ctx);
+
+	/* Open default message store */
+	mapi_object_init(&obj_store);
+	retval = OpenMsgStore(session, &obj_store);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("OpenMsgStore", GetLastError());
+		exit (1);
+	}
+
+	retval = mapidump_walk(mem_ctx, ocb_ctx, &obj_store, worker, workers);
+
+	/* Uninitialize MAPI and OCB subsystem */
+	mapi_object_release(&obj_store);
+	MAPIUninitialize(mapi_ctx);
+	ocb_release(ocb_ctx);
+
+	return retval;
+}
+
+/*
+ * Back up the mailbox with several processes, each with its own MAPI
+ * session, sharing the folders below the top of the store
+ */
+static enum MAPISTATUS mapidump_backup_parallel(TALLOC_CTX *mem_ctx, const struct mapidump_options *opts,
+						unsigned int workers)
+{
+	pid_t			*pids;
+	unsigned int		i;
+	int			status;
+	enum MAPISTATUS		retval = MAPI_E_SUCCESS;
+	time_t			started = time(NULL);
+
+	pids = talloc_array(mem_ctx, pid_t, workers);
+	fflush(stdout);
+
+	for (i = 0; i < workers; i++) {
+		pids[i] = fork();
+		if (pids[i] == -1) {
+			perror("fork");
+			exit (1);
+		}
+		if (pids[i] == 0) {
+			status = mapidump_backup(mem_ctx, opts, i, workers);
+			fflush(stdout);
+			_exit(status == MAPI_E_SUCCESS ? 0 : 1);
+		}
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "[!] worker %u failed\n", i);
+			retval = MAPI_E_CALL_FAILED;
+		}
+	}
+	talloc_free(pids);
+
+	printf("[+] %u workers backed up the mailbox in %ld seconds\n", workers, (long)(time(NULL) - started));
+
+	return retval;
 }
 
 
@@ -343,10 +617,8 @@ int main(int argc, const char *argv[])
 {
 	TALLOC_CTX			*mem_ctx;
 	enum MAPISTATUS			retval;
-	struct ocb_context		*ocb_ctx = NULL;
 	struct mapi_context		*mapi_ctx;
-	struct mapi_session		*session = NULL;
-	mapi_object_t			obj_store;
+	struct mapidump_options		opts;
 	poptContext			pc;
 	int				opt;
 	/* command line options */
@@ -356,10 +628,11 @@ int main(int argc, const char *argv[])
 	const char			*opt_backupdb = NULL;
 	const char			*opt_debug = NULL;
 	bool				opt_dumpdata = false;
+	int				opt_workers = 1;
 
 	enum {OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD, 
 	      OPT_MAILBOX, OPT_CONFIG, OPT_BACKUPDB, OPT_PF,
-	      OPT_DEBUG, OPT_DUMPDATA};
+	      OPT_DEBUG, OPT_DUMPDATA, OPT_WORKERS, OPT_SYNC_STATE};
 
 	struct poptOption long_options[] = {
 		POPT_AUTOHELP
@@ -369,6 +642,8 @@ int main(int argc, const char *argv[])
 		{"backup-db", 'b', POPT_ARG_STRING, NULL, OPT_BACKUPDB, "set the openchangebackup store path", NULL},
 		{"debuglevel", 0, POPT_ARG_STRING, NULL, OPT_DEBUG, "set the debug level", NULL},
 		{"dump-data", 0, POPT_ARG_NONE, NULL, OPT_DUMPDATA, "dump the hex data", NULL},
+		{"workers", 'w', POPT_ARG_INT, &opt_workers, OPT_WORKERS, "back up with several MAPI sessions in parallel", "COUNT"},
+		{"sync-state", 's', POPT_ARG_STRING, NULL, OPT_SYNC_STATE, "only back up the messages changed since the states saved in DIRECTORY", "DIRECTORY"},
 		POPT_OPENCHANGE_VERSION
 		{ NULL, 0, 0, NULL, 0, NULL, NULL }
 	};
@@ -397,6 +672,9 @@ int main(int argc, const char *argv[])
 		case OPT_BACKUPDB:
 			opt_backupdb = poptGetOptArg(pc);
 			break;
+		case OPT_SYNC_STATE:
+			sync_dir = poptGetOptArg(pc);
+			break;
 		}
 	}
 
@@ -405,66 +683,46 @@ int main(int argc, const char *argv[])
 		opt_profdb = talloc_asprintf(mem_ctx, DEFAULT_PROFDB, getenv("HOME"));
 	}
 
-	/* Initialize MAPI subsystem */
-	retval = MAPIInitialize(&mapi_ctx, opt_profdb);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_errstr("MAPIInitialize", GetLastError());
+	if (sync_dir && mkdir(sync_dir, 0700) == -1 && errno != EEXIST) {
+		perror(sync_dir);
 		exit (1);
 	}
 
-	/* debug options */
-	SetMAPIDumpData(mapi_ctx, opt_dumpdata);
-
-	if (opt_debug) {
-		SetMAPIDebugLevel(mapi_ctx, atoi(opt_debug));
-	}
-
-	/* If no profile is specified try to load the default one from
-	 * the database 
-	 */
-	if (!opt_profname) {
-		retval = GetDefaultProfile(mapi_ctx, &opt_profname);
-		if (retval != MAPI_E_SUCCESS) {
-			mapi_errstr("GetDefaultProfile", GetLastError());
-			exit (1);
-		}
-	}
-
+	/* The backup database is named after the profile */
 	if (!opt_backupdb) {
+		if (!opt_profname) {
+			retval = MAPIInitialize(&mapi_ctx, opt_profdb);
+			if (retval != MAPI_E_SUCCESS) {
+				mapi_errstr("MAPIInitialize", GetLastError());
+				exit (1);
+			}
+			retval = GetDefaultProfile(mapi_ctx, &opt_profname);
+			if (retval != MAPI_E_SUCCESS) {
+				mapi_errstr("GetDefaultProfile", GetLastError());
+				exit (1);
+			}
+			opt_profname = talloc_steal(mem_ctx, opt_profname);
+			MAPIUninitialize(mapi_ctx);
+		}
 		opt_backupdb = talloc_asprintf(mem_ctx, DEFAULT_OCBDB, 
 					       getenv("HOME"),
 					       opt_profname);
 	}
 
-	/* Initialize OpenChange Backup subsystem */
-	if (!(ocb_ctx = ocb_init(mem_ctx, opt_backupdb))) {
-		talloc_free(mem_ctx);
-		exit(-1);
-	}
-
-	/* We only need to log on EMSMDB to backup Mailbox store or Public Folders */
-	retval = MapiLogonProvider(mapi_ctx, &session, opt_profname, opt_password, PROVIDER_ID_EMSMDB);
-	talloc_free(opt_profname);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_errstr("MapiLogonEx", GetLastError());
-		exit (1);
+	opts.profdb = opt_profdb;
+	opts.profname = opt_profname;
+	opts.password = opt_password;
+	opts.backupdb = opt_backupdb;
+	opts.debug = opt_debug;
+	opts.dumpdata = opt_dumpdata;
+
+	if (opt_workers <= 1) {
+		retval = mapidump_backup(mem_ctx, &opts, 0, 1);
+	} else {
+		retval = mapidump_backup_parallel(mem_ctx, &opts, opt_workers);
 	}
 
-	/* Open default message store */
-	mapi_object_init(&obj_store);
-	retval = OpenMsgStore(session, &obj_store);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_errstr("OpenMsgStore", GetLastError());
-		exit (1);
-	}
-
-	retval = mapidump_walk(mem_ctx, ocb_ctx, &obj_store);
-
-	/* Uninitialize MAPI and OCB subsystem */
-	mapi_object_release(&obj_store);
-	MAPIUninitialize(mapi_ctx);
-	ocb_release(ocb_ctx);
 	talloc_free(mem_ctx);
 
-	return 0;
+	return retval ? 1 : 0;
 }
@@ -54,6 +54,127 @@ static char* read_stream(char *s, size_t size, void *d)
   return c;
 }
 
+static void import_progress(uint32_t done, uint32_t total, void *private_data)
+{
+	printf("Imported %u/%u events\n", done, total);
+}
+
+#define	EXCHANGE2ICAL_MID	"X-OPENCHANGE-MID"
+
+/* Return the message identifier an event was converted from, 0 if it
+   was not tagged by a synchronization */
+static mapi_id_t get_event_mid(icalcomponent *vevent)
+{
+	icalproperty	*prop;
+
+	for (prop = icalcomponent_get_first_property(vevent, ICAL_X_PROPERTY); prop;
+	     prop = icalcomponent_get_next_property(vevent, ICAL_X_PROPERTY)) {
+		if (!strcmp(icalproperty_get_x_name(prop), EXCHANGE2ICAL_MID)) {
+			return strtoull(icalproperty_get_x(prop), NULL, 16);
+		}
+	}
+	return 0;
+}
+
+static bool has_timezone(icalcomponent *vcal, const char *tzid)
+{
+	icalcomponent	*vtimezone;
+	icalproperty	*prop;
+
+	for (vtimezone = icalcomponent_get_first_component(vcal, ICAL_VTIMEZONE_COMPONENT); vtimezone;
+	     vtimezone = icalcomponent_get_next_component(vcal, ICAL_VTIMEZONE_COMPONENT)) {
+		prop = icalcomponent_get_first_property(vtimezone, ICAL_TZID_PROPERTY);
+		if (prop && tzid && !strcmp(icalproperty_get_tzid(prop), tzid)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Update the iCalendar previously written to filename, or create it,
+   with the appointments changed since the sync state */
+static icalcomponent *sync_ical(mapi_object_t *obj_folder, const char *filename, struct octool_sync *sync)
+{
+	enum MAPISTATUS		retval;
+	FILE			*fp;
+	icalparser		*parser;
+	icalcomponent		*vcal = NULL;
+	icalcomponent		*ical;
+	icalcomponent		*comp;
+	icalcomponent		*next;
+	icalproperty		*prop;
+	mapi_id_t		mid;
+	char			*value;
+	uint32_t		removed = 0;
+	uint32_t		i;
+
+	retval = octool_sync_contents(obj_folder, sync);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("octool_sync_contents", retval);
+		return NULL;
+	}
+	printf("%u appointments changed, %u deleted since the last synchronization\n",
+	       sync->changed_count, sync->deleted_count);
+
+	if ((fp = fopen(filename, "r")) != NULL) {
+		parser = icalparser_new();
+		icalparser_set_gen_data(parser, fp);
+		vcal = icalparser_parse(parser, read_stream);
+		icalparser_free(parser);
+		fclose(fp);
+	}
+
+	/* Drop the events of the changed and deleted appointments */
+	if (vcal) {
+		for (comp = icalcomponent_get_first_component(vcal, ICAL_VEVENT_COMPONENT); comp; comp = next) {
+			next = icalcomponent_get_next_component(vcal, ICAL_VEVENT_COMPONENT);
+			mid = get_event_mid(comp);
+			if (!mid) continue;
+			for (i = 0; i < sync->changed_count && sync->changed[i] != mid; i++);
+			if (i < sync->changed_count || octool_sync_deleted(sync, mid)) {
+				icalcomponent_remove_component(vcal, comp);
+				icalcomponent_free(comp);
+				removed++;
+			}
+		}
+	}
+
+	/* Convert the changed appointments and tag their events */
+	for (i = 0; i < sync->changed_count; i++) {
+		ical = Exchange2IcalMessage(obj_folder, sync->changed[i]);
+		if (!ical) continue;
+
+		value = talloc_asprintf(NULL, "%"PRIx64, sync->changed[i]);
+		for (comp = icalcomponent_get_first_component(ical, ICAL_VEVENT_COMPONENT); comp;
+		     comp = icalcomponent_get_next_component(ical, ICAL_VEVENT_COMPONENT)) {
+			prop = icalproperty_new_x(value);
+			icalproperty_set_x_name(prop, EXCHANGE2ICAL_MID);
+			icalcomponent_add_property(comp, prop);
+		}
+		talloc_free(value);
+
+		if (!vcal) {
+			vcal = ical;
+			continue;
+		}
+		for (comp = icalcomponent_get_first_component(ical, ICAL_ANY_COMPONENT); comp; comp = next) {
+			next = icalcomponent_get_next_component(ical, ICAL_ANY_COMPONENT);
+			if (icalcomponent_isa(comp) == ICAL_VTIMEZONE_COMPONENT) {
+				prop = icalcomponent_get_first_property(comp, ICAL_TZID_PROPERTY);
+				if (!prop || has_timezone(vcal, icalproperty_get_tzid(prop))) continue;
+			} else if (icalcomponent_isa(comp) != ICAL_VEVENT_COMPONENT) {
+				continue;
+			}
+			icalcomponent_remove_component(ical, comp);
+			icalcomponent_add_component(vcal, comp);
+		}
+		icalcomponent_free(ical);
+	}
+	printf("%u events removed from %s\n", removed, filename);
+
+	return vcal;
+}
+
 int main(int argc, const char *argv[])
 {
 	enum MAPISTATUS			retval;
@@ -68,6 +189,8 @@ int main(int argc, const char *argv[])
 	const char			*opt_filename = NULL;
 	const char			*opt_icalsync = NULL;
 	const char			*opt_range = NULL;
+	const char			*opt_sync_state = NULL;
+	struct octool_sync		*sync = NULL;
 	bool				opt_dumpdata = false;
 	FILE 	 			*fp = NULL;
 	mapi_id_t			fid;
@@ -78,12 +201,14 @@ int main(int argc, const char *argv[])
 	struct tm			end;
 	icalparser			*parser;
 	icalcomponent			*ical;
-	icalcomponent			*vevent;
+	struct ical2exchange_status	*import_status = NULL;
+	uint32_t			import_count = 0;
+	uint32_t			i;
 	TALLOC_CTX			*mem_ctx;
 
 	
 
-	enum { OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD, OPT_DEBUG, OPT_DUMPDATA, OPT_FILENAME, OPT_RANGE, OPT_ICALSYNC };
+	enum { OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD, OPT_DEBUG, OPT_DUMPDATA, OPT_FILENAME, OPT_RANGE, OPT_ICALSYNC, OPT_SYNC_STATE };
 
 	struct poptOption long_options[] = {
 		POPT_AUTOHELP
@@ -93,6 +218,7 @@ int main(int argc, const char *argv[])
 		{ "icalsync", 	'i', POPT_ARG_STRING, NULL, OPT_ICALSYNC,	"set the icalendar to convert to exchange",	NULL },
 		{ "filename",	'o', POPT_ARG_STRING, NULL, OPT_FILENAME,	"set the output iCalendar filename",		NULL },
 		{ "range",	'R', POPT_ARG_STRING, NULL, OPT_RANGE,		"set the range of accepted start dates", 	NULL },
+		{ "sync-state",	's', POPT_ARG_STRING, NULL, OPT_SYNC_STATE,	"only convert the appointments changed since the state saved in this file", NULL },
 		{ "debuglevel",	'd', POPT_ARG_STRING, NULL, OPT_DEBUG,		"set the debug level",				NULL },
 		{ "dump-data",	  0, POPT_ARG_NONE,   NULL, OPT_DUMPDATA,	"dump the hex data",				NULL },
 		POPT_OPENCHANGE_VERSION
@@ -116,6 +242,9 @@ int main(int argc, const char *argv[])
 		case OPT_RANGE:
 			opt_range = poptGetOptArg(pc);
 			break;
+		case OPT_SYNC_STATE:
+			opt_sync_state = poptGetOptArg(pc);
+			break;
 		case OPT_PROFILE:
 			opt_profname = poptGetOptArg(pc);
 			break;
@@ -138,6 +267,17 @@ int main(int argc, const char *argv[])
 		opt_profdb = talloc_asprintf(mem_ctx, DEFAULT_PROFDB, getenv("HOME"));
 	}
 
+	if (opt_sync_state) {
+		if (!opt_filename || opt_range) {
+			fprintf(stderr, "--sync-state requires --filename and cannot be used with --range\n");
+			return 1;
+		}
+		sync = octool_sync_load(mem_ctx, opt_sync_state);
+		if (!sync) {
+			return 1;
+		}
+	}
+
 	/* Initialize MAPI subsystem */
 	retval = MAPIInitialize(&mapi_ctx, opt_profdb);
 	if (retval != MAPI_E_SUCCESS) {
@@ -195,11 +335,19 @@ int main(int argc, const char *argv[])
 
 			icalcomponent_strip_errors(ical);
 		
-			vevent = icalcomponent_get_first_component(ical, ICAL_VEVENT_COMPONENT);
-			while(vevent){
-				_IcalEvent2Exchange(&obj_folder, vevent);
-				vevent = icalcomponent_get_next_component(ical, ICAL_VEVENT_COMPONENT);
-			}	
+			retval = Ical2Exchange(mem_ctx, &obj_folder, ical, import_progress, NULL, &import_status, &import_count);
+			if (retval != MAPI_E_SUCCESS) {
+				mapi_errstr("Ical2Exchange", GetLastError());
+			}
+			for (i = 0; import_status && i < import_count; i++) {
+				if (import_status[i].retval != MAPI_E_SUCCESS) {
+					printf("Event %s not imported: %s\n",
+					       import_status[i].uid ? import_status[i].uid : "without UID",
+					       mapi_get_errstr(import_status[i].retval));
+				}
+			}
+			talloc_free(import_status);
+			import_status = NULL;
 			icalcomponent_free(ical);
 			icalparser_free(parser);
 			fclose(fp);
@@ -207,7 +355,9 @@ int main(int argc, const char *argv[])
 		}
 	}
 	
-	if(opt_range){
+	if(opt_sync_state){
+		vcal = sync_ical(&obj_folder, opt_filename, sync);
+	} else if(opt_range){
 		getRange(opt_range, &start, &end);
 		vcal = Exchange2IcalRange(&obj_folder, &start, &end);
 	} else {
@@ -232,6 +382,9 @@ int main(int argc, const char *argv[])
 				printf("BOGUS write length: %zi", bytesWritten);
 			}
 			fclose(fp);
+			if (sync && !octool_sync_save(sync, opt_sync_state)) {
+				exit (1);
+			}
 		}
 		free(cal);
 		icalcomponent_free(vcal);
@@ -25,6 +25,7 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -56,6 +57,11 @@
  */
 #define	MAX_READ_SIZE	12000
 
+/*
+ * Number of messages opened and read in a single EMSMDB round-trip
+ */
+#define	EXCHANGE2MBOX_BATCH	0xa
+
 static int message_error = 0;	/* did we get an error processing message */
 
 static bool opt_test = false;
@@ -999,27 +1005,393 @@ old_code:
 
 
 
-int main(int argc, const char *argv[])
+/*
+ * Options shared by the parent and the worker processes
+ */
+struct exchange2mbox_options {
+	const char	*profdb;
+	const char	*profname;
+	const char	*password;
+	const char	*debug;
+	bool		dumpdata;
+};
+
+/*
+ * Initialize MAPI and log on the profile, exit on failure
+ */
+static struct mapi_session *logon(TALLOC_CTX *mem_ctx, const struct exchange2mbox_options *opts,
+				  struct mapi_context **mapi_ctx)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_session	*session = NULL;
+	char			*profname;
+
+	retval = MAPIInitialize(mapi_ctx, opts->profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", GetLastError());
+		exit (1);
+	}
+
+	/* debug options */
+	SetMAPIDumpData(*mapi_ctx, opts->dumpdata);
+
+	if (opts->debug) {
+		SetMAPIDebugLevel(*mapi_ctx, atoi(opts->debug));
+	}
+
+	/* if no profile is supplied use the default one */
+	if (opts->profname) {
+		profname = talloc_strdup(mem_ctx, opts->profname);
+	} else {
+		retval = GetDefaultProfile(*mapi_ctx, &profname);
+		if (retval != MAPI_E_SUCCESS) {
+			printf("No profile specified and no default profile found\n");
+			exit (1);
+		}
+	}
+
+	retval = MapiLogonEx(*mapi_ctx, &session, profname, opts->password);
+	talloc_free(profname);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MapiLogonEx", GetLastError());
+		exit (1);
+	}
+
+	/* not sure about this,  but it works and it's nice to have it there */
+	session->profile->mapi_ctx = *mapi_ctx;
+
+	return session;
+}
+
+/*
+ * Open a batch of Inbox messages, fetch their properties in a single
+ * round-trip and export those not already in the profile to fp
+ */
+static void export_messages(TALLOC_CTX *mem_ctx, FILE *fp, struct mapi_profile *profile,
+			    struct mapi_batch *batch, mapi_object_t *obj_store,
+			    mapi_object_t *obj_inbox, struct SPropTagArray *SPropTagArray,
+			    mapi_id_t fid, const mapi_id_t *mids, uint32_t count)
 {
-	TALLOC_CTX			*mem_ctx = NULL;
 	enum MAPISTATUS			retval;
-	struct mapi_context		*mapi_ctx = NULL;
-	struct mapi_session		*session = NULL;
-	struct mapi_profile		*profile = NULL;
+	mapi_object_t			obj_messages[EXCHANGE2MBOX_BATCH];
+	mapi_object_t			*obj_message;
+	struct SPropValue		*lpProps[EXCHANGE2MBOX_BATCH];
+	uint32_t			counts[EXCHANGE2MBOX_BATCH];
+	enum MAPISTATUS			open_status[EXCHANGE2MBOX_BATCH];
+	enum MAPISTATUS			props_status[EXCHANGE2MBOX_BATCH];
+	struct SRow			aRow;
+	unsigned int			i;
+	const char			*msgid;
+
+	for (i = 0; i < count; i++) {
+		mapi_object_init(&obj_messages[i]);
+		mapi_batch_OpenMessage(batch, obj_store, fid, mids[i],
+				       &obj_messages[i], 0, &open_status[i]);
+		mapi_batch_GetProps(batch, &obj_messages[i], MAPI_UNICODE, SPropTagArray,
+				    &lpProps[i], &counts[i], &props_status[i]);
+	}
+	retval = mapi_batch_flush(batch);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("mapi_batch_flush", GetLastError());
+		exit (1);
+	}
+
+	for (i = 0; i < count; i++) {
+		obj_message = &obj_messages[i];
+		if (open_status[i] == MAPI_E_SUCCESS) {
+			if (props_status[i] != MAPI_E_SUCCESS) {
+				fprintf(stderr, "Badness getting row %d attrs\n", i);
+				exit (1);
+			}
+
+			/* Build a SRow structure */
+			aRow.ulAdrEntryPad = 0;
+			aRow.cValues = counts[i];
+			aRow.lpProps = lpProps[i];
+
+			msgid = (const char *) octool_get_propval(&aRow, PR_INTERNET_MESSAGE_ID);
+			if (msgid) {
+				retval = FindProfileAttr(profile, "Message-ID", msgid);
+				if (GetLastError() == MAPI_E_NOT_FOUND) {
+					bool ok;
+					
+					message_error = 0;
+					ok = message2mbox(mem_ctx, fp, &aRow, obj_store, obj_inbox, obj_message, 0);
+					if (!ok) {
+						printf("Message-ID: %s error, not added to %s\n", msgid, profile->profname);
+					} else if (message_error) {
+						printf("Message-ID: %s error, ignoring\n", msgid);
+						fprintf(stderr, "Message-ID: %s error, ignoring message (check with OWA if you can, will retry next time)\n", msgid);
+					} else if (opt_test) {
+						printf("Message-ID: %s saved but not updated in %s\n", msgid, profile->profname);
+					} else if
+					(mapi_profile_add_string_attr(profile->mapi_ctx, profile->profname, "Message-ID", msgid) != MAPI_E_SUCCESS) {
+						mapi_errstr("mapi_profile_add_string_attr", GetLastError());
+					} else {
+						printf("Message-ID: %s added to profile %s\n", msgid, profile->profname);
+					}
+				} else {
+					printf("Message-ID: %s already in profile %s\n", msgid, profile->profname);
+				}
+			} else {
+				fprintf(stderr, "%s: message with no msgid cannot be downloaded\n", profile->profname);
+			}
+			talloc_free(lpProps[i]);
+		} else {
+			fprintf(stderr, "could not open row %d: retval=%d\n", i, open_status[i]);
+		}
+		mapi_object_release(obj_message);
+		errno = 0;
+	}
+}
+
+/*
+ * Export the Inbox messages not already in the profile to fp. With
+ * several workers, worker exports its share of the contents table.
+ * With a sync state, only the messages changed since the state was
+ * saved are looked at and the state is updated.
+ */
+static enum MAPISTATUS export_inbox(TALLOC_CTX *mem_ctx, FILE *fp, struct mapi_session *session,
+				    unsigned int worker, unsigned int workers,
+				    struct octool_sync *sync)
+{
+	enum MAPISTATUS			retval;
+	struct mapi_profile		*profile = session->profile;
 	mapi_object_t			obj_store;
 	mapi_object_t			obj_inbox;
 	mapi_object_t			obj_table;
-	mapi_object_t			obj_message;
 	mapi_id_t			id_inbox;
+	mapi_id_t			mids[EXCHANGE2MBOX_BATCH];
 	uint32_t			count;
+	uint32_t			first;
+	uint32_t			last;
+	uint32_t			done;
+	uint32_t			row;
 	struct SPropTagArray		*SPropTagArray = NULL;
-	struct SPropValue		*lpProps;
-	struct SRow			aRow;
+	struct mapi_batch		*batch;
 	struct SRowSet			rowset;
+	struct timespec			start, now;
+	double				elapsed;
+	unsigned int			i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	/* Open the default message store */
+	mapi_object_init(&obj_store);
+	retval = OpenMsgStore(session, &obj_store);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("OpenMsgStore", GetLastError());
+		exit (1);
+	}
+
+	/* Open Inbox */
+	retval = GetReceiveFolder(&obj_store, &id_inbox, NULL);
+	MAPI_RETVAL_IF(retval, retval, NULL);
+
+	mapi_object_init(&obj_inbox);
+	retval = OpenFolder(&obj_store, id_inbox, &obj_inbox);
+	MAPI_RETVAL_IF(retval, retval, NULL);
+
+	mapi_object_init(&obj_table);
+	if (sync) {
+		retval = octool_sync_contents(&obj_inbox, sync);
+		if (retval != MAPI_E_SUCCESS) {
+			mapi_errstr("octool_sync_contents", retval);
+			return retval;
+		}
+		printf("%u messages changed, %u deleted since the last synchronization\n",
+		       sync->changed_count, sync->deleted_count);
+		first = 0;
+		last = sync->changed_count;
+	} else {
+		retval = GetContentsTable(&obj_inbox, &obj_table, 0, &count);
+		MAPI_RETVAL_IF(retval, retval, NULL);
+
+		SPropTagArray = set_SPropTagArray(mem_ctx, 0x5,
+						  PR_FID,
+						  PR_MID,
+						  PR_INST_ID,
+						  PR_INSTANCE_NUM,
+						  PR_INTERNET_MESSAGE_ID);
+		retval = SetColumns(&obj_table, SPropTagArray);
+		MAPIFreeBuffer(SPropTagArray);
+		MAPI_RETVAL_IF(retval, retval, NULL);
+
+		/* Workers take consecutive ranges of rows */
+		first = (uint64_t)count * worker / workers;
+		last = (uint64_t)count * (worker + 1) / workers;
+		if (first) {
+			retval = SeekRow(&obj_table, BOOKMARK_BEGINNING, first, &row);
+			MAPI_RETVAL_IF(retval, retval, NULL);
+		}
+	}
+
+	retval = mapi_batch_begin(mem_ctx, session, &batch);
+	MAPI_RETVAL_IF(retval, retval, NULL);
+
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x1c,
+					  PR_INTERNET_MESSAGE_ID,
+					  PR_INTERNET_MESSAGE_ID_UNICODE,
+					  PR_CONVERSATION_TOPIC,
+					  PR_CONVERSATION_TOPIC_UNICODE,
+					  PR_MESSAGE_DELIVERY_TIME,
+					  PR_MSG_EDITOR_FORMAT,
+					  PR_BODY,
+					  PR_BODY_UNICODE,
+					  PR_HTML,
+					  PR_RTF_COMPRESSED,
+					  PR_RTF_IN_SYNC,
+					  PR_SENT_REPRESENTING_NAME,
+					  PR_SENT_REPRESENTING_NAME_UNICODE,
+					  PR_DISPLAY_TO,
+					  PR_DISPLAY_TO_UNICODE,
+					  PR_DISPLAY_CC,
+					  PR_DISPLAY_CC_UNICODE,
+					  PR_DISPLAY_BCC,
+					  PR_DISPLAY_BCC_UNICODE,
+					  PR_HASATTACH,
+					  PR_TRANSPORT_MESSAGE_HEADERS,
+					  PR_SUBJECT_PREFIX,
+					  PR_SUBJECT_PREFIX_UNICODE,
+					  PR_NORMALIZED_SUBJECT,
+					  PR_NORMALIZED_SUBJECT_UNICODE,
+					  PR_SUBJECT,
+					  PR_SUBJECT_UNICODE,
+					  PR_ENTRYID);
+
+	for (done = 0; first + done < last; done += count) {
+		if (sync) {
+			count = MIN(EXCHANGE2MBOX_BATCH, last - done);
+			export_messages(mem_ctx, fp, profile, batch, &obj_store, &obj_inbox,
+					SPropTagArray, id_inbox, sync->changed + done, count);
+		} else {
+			retval = QueryRows(&obj_table, MIN(EXCHANGE2MBOX_BATCH, last - first - done),
+					   TBL_ADVANCE, TBL_FORWARD_READ, &rowset);
+			if (retval == MAPI_E_NOT_FOUND || !rowset.cRows) break;
+
+			count = rowset.cRows;
+			for (i = 0; i < count; i++) {
+				mids[i] = rowset.aRow[i].lpProps[1].value.d;
+			}
+			export_messages(mem_ctx, fp, profile, batch, &obj_store, &obj_inbox,
+					SPropTagArray, rowset.aRow[0].lpProps[0].value.d, mids, count);
+		}
+
+		if (workers > 1) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+			fprintf(stderr, "[+] worker %u: %u/%u messages, %.1f messages/s\n",
+				worker, done + count, last - first,
+				elapsed > 0 ? (done + count) / elapsed : 0);
+		}
+	}
+	MAPIFreeBuffer(SPropTagArray);
+	talloc_free(batch);
+
+	mapi_object_release(&obj_table);
+	mapi_object_release(&obj_inbox);
+	mapi_object_release(&obj_store);
+
+	return MAPI_E_SUCCESS;
+}
+
+/*
+ * Append the mbox written by a worker to fp and remove it
+ */
+static bool merge_worker_mbox(FILE *fp, const char *path)
+{
+	FILE	*wfp;
+	char	buf[BUFSIZ];
+	size_t	len;
+
+	if ((wfp = fopen(path, "r")) == NULL) {
+		perror(path);
+		return false;
+	}
+	while ((len = fread(buf, 1, sizeof (buf), wfp)) > 0) {
+		if (fwrite(buf, 1, len, fp) != len) {
+			perror("fwrite");
+			fclose(wfp);
+			return false;
+		}
+	}
+	fclose(wfp);
+	unlink(path);
+
+	return true;
+}
+
+/*
+ * Export the Inbox with several processes, each with its own MAPI
+ * session, and append their mbox files to fp in order
+ */
+static enum MAPISTATUS export_inbox_parallel(TALLOC_CTX *mem_ctx, FILE *fp, const char *mbox,
+					     const struct exchange2mbox_options *opts, unsigned int workers)
+{
+	struct mapi_context	*mapi_ctx;
+	struct mapi_session	*session;
+	pid_t			*pids;
+	char			*path;
+	FILE			*wfp;
+	unsigned int		i;
+	int			status;
+	enum MAPISTATUS		retval = MAPI_E_SUCCESS;
+	time_t			started = time(NULL);
+
+	pids = talloc_array(mem_ctx, pid_t, workers);
+	fflush(fp);
+	fflush(stdout);
+
+	for (i = 0; i < workers; i++) {
+		pids[i] = fork();
+		if (pids[i] == -1) {
+			perror("fork");
+			exit (1);
+		}
+		if (pids[i] == 0) {
+			path = talloc_asprintf(mem_ctx, "%s.%u", mbox, i);
+			if ((wfp = fopen(path, "w")) == NULL) {
+				perror(path);
+				_exit (1);
+			}
+			session = logon(mem_ctx, opts, &mapi_ctx);
+			status = export_inbox(mem_ctx, wfp, session, i, workers, NULL);
+			fclose(wfp);
+			MAPIUninitialize(mapi_ctx);
+			fflush(stdout);
+			_exit(status == MAPI_E_SUCCESS ? 0 : 1);
+		}
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "[!] worker %u failed, its messages will be fetched next time\n", i);
+			retval = MAPI_E_CALL_FAILED;
+		}
+		/* Whatever a failed worker wrote is in the profile already */
+		path = talloc_asprintf(mem_ctx, "%s.%u", mbox, i);
+		if (!merge_worker_mbox(fp, path)) {
+			retval = MAPI_E_CALL_FAILED;
+		}
+		talloc_free(path);
+	}
+	talloc_free(pids);
+
+	printf("[+] %u workers exported the Inbox in %ld seconds\n", workers, (long)(time(NULL) - started));
+
+	return retval;
+}
+
+int main(int argc, const char *argv[])
+{
+	TALLOC_CTX			*mem_ctx = NULL;
+	enum MAPISTATUS			retval;
+	struct mapi_context		*mapi_ctx = NULL;
+	struct mapi_session		*session = NULL;
+	struct exchange2mbox_options	opts;
 	poptContext			pc;
 	int				opt;
 	FILE				*fp;
-	unsigned int			i;
 	const char			*opt_profdb = NULL;
 	char				*opt_profname = NULL;
 	const char			*opt_password = NULL;
@@ -1027,10 +1399,12 @@ int main(int argc, const char *argv[])
 	bool				opt_update = false;
 	bool				opt_dumpdata = false;
 	const char			*opt_debug = NULL;
-	const char			*msgid;
+	int				opt_workers = 1;
+	const char			*opt_sync_state = NULL;
+	struct octool_sync		*sync = NULL;
 
 	enum {OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD, OPT_MBOX, OPT_UPDATE,
-	      OPT_DEBUG, OPT_DUMPDATA, OPT_TEST};
+	      OPT_DEBUG, OPT_DUMPDATA, OPT_TEST, OPT_WORKERS, OPT_SYNC_STATE};
 
 	struct poptOption long_options[] = {
 		POPT_AUTOHELP
@@ -1042,6 +1416,8 @@ int main(int argc, const char *argv[])
 		{"update", 'u', POPT_ARG_NONE, 0, OPT_UPDATE, "mirror mbox changes back to the Exchange server", NULL},
 		{"debuglevel", 'd', POPT_ARG_STRING, NULL, OPT_DEBUG, "set the debug level", "LEVEL"},
 		{"dump-data", 0, POPT_ARG_NONE, NULL, OPT_DUMPDATA, "dump the hex data", NULL},
+		{"workers", 'w', POPT_ARG_INT, &opt_workers, OPT_WORKERS, "export with several MAPI sessions in parallel", "COUNT"},
+		{"sync-state", 's', POPT_ARG_STRING, NULL, OPT_SYNC_STATE, "only export the messages changed since the state saved in FILENAME", "FILENAME"},
 		POPT_OPENCHANGE_VERSION
 		{ NULL, 0, POPT_ARG_NONE, NULL, 0, NULL, NULL }
 	};
@@ -1078,6 +1454,9 @@ int main(int argc, const char *argv[])
 		case OPT_DUMPDATA:
 			opt_dumpdata = true;
 			break;
+		case OPT_SYNC_STATE:
+			opt_sync_state = poptGetOptArg(pc);
+			break;
 		}
 	}
 
@@ -1093,183 +1472,70 @@ int main(int argc, const char *argv[])
 		opt_mbox = talloc_asprintf(mem_ctx, DEFAULT_MBOX, getenv("HOME"));
 	}
 
-	/**
-	 * Open the MBOX
-	 */
-
-	if ((fp = fopen(opt_mbox, "a+")) == NULL) {
-		perror("fopen");
-		exit (1);
-	}
-
-	/**
-	 * Initialize MAPI subsystem
-	 */
-
-	retval = MAPIInitialize(&mapi_ctx, opt_profdb);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_errstr("MAPIInitialize", GetLastError());
+	if (opt_sync_state && opt_workers > 1) {
+		fprintf(stderr, "--sync-state and --workers cannot be used together\n");
 		exit (1);
 	}
 
-	/* debug options */
-	SetMAPIDumpData(mapi_ctx, opt_dumpdata);
-
-	if (opt_debug) {
-		SetMAPIDebugLevel(mapi_ctx, atoi(opt_debug));
-	}
-
-	/* if no profile is supplied use the default one */
-	if (!opt_profname) {
-		retval = GetDefaultProfile(mapi_ctx, &opt_profname);
-		if (retval != MAPI_E_SUCCESS) {
-			printf("No profile specified and no default profile found\n");
+	if (opt_sync_state) {
+		sync = octool_sync_load(mem_ctx, opt_sync_state);
+		if (!sync) {
 			exit (1);
 		}
 	}
-	
-	retval = MapiLogonEx(mapi_ctx, &session, opt_profname, opt_password);
-	talloc_free(opt_profname);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_errstr("MapiLogonEx", GetLastError());
-		exit (1);
-	}
-	profile = session->profile;
 
-	/* not sure about this,  but it works and it's nice to have it there */
-	profile->mapi_ctx = mapi_ctx;
+	/**
+	 * Open the MBOX
+	 */
 
-	/* do the updates now */
-	if (opt_update == true) {
-		retval = update(mem_ctx, fp, session);
-		if (retval != MAPI_E_SUCCESS) {
-			printf("Problem encountered during update: %d\n", retval);
-			exit (1);
-		}
-	}
-	
-	/* Open the default message store */
-	mapi_object_init(&obj_store);
-	retval = OpenMsgStore(session, &obj_store);
-	if (retval != MAPI_E_SUCCESS) {
-		mapi_errstr("OpenMsgStore", GetLastError());
+	if ((fp = fopen(opt_mbox, "a+")) == NULL) {
+		perror("fopen");
 		exit (1);
 	}
 
-	/* Open Inbox */
-	retval = GetReceiveFolder(&obj_store, &id_inbox, NULL);
-	MAPI_RETVAL_IF(retval, retval, mem_ctx);
-
-	mapi_object_init(&obj_inbox);
-	retval = OpenFolder(&obj_store, id_inbox, &obj_inbox);
-	MAPI_RETVAL_IF(retval, retval, mem_ctx);
-
-	mapi_object_init(&obj_table);
-	retval = GetContentsTable(&obj_inbox, &obj_table, 0, &count);
-	MAPI_RETVAL_IF(retval, retval, mem_ctx);
-
-	SPropTagArray = set_SPropTagArray(mem_ctx, 0x5,
-					  PR_FID,
-					  PR_MID,
-					  PR_INST_ID,
-					  PR_INSTANCE_NUM,
-					  PR_INTERNET_MESSAGE_ID);
-	retval = SetColumns(&obj_table, SPropTagArray);
-	MAPIFreeBuffer(SPropTagArray);
-	MAPI_RETVAL_IF(retval, retval, mem_ctx);
-
-	while ((retval = QueryRows(&obj_table, 0xa, TBL_ADVANCE, TBL_FORWARD_READ, &rowset)) != MAPI_E_NOT_FOUND && rowset.cRows) {
-		for (i = 0; i < rowset.cRows; i++) {
-			mapi_object_init(&obj_message);
-			retval = OpenMessage(&obj_store, 
-					     rowset.aRow[i].lpProps[0].value.d, 
-					     rowset.aRow[i].lpProps[1].value.d, 
-					     &obj_message, 0);
-			if (retval == MAPI_E_SUCCESS) {
-				SPropTagArray = set_SPropTagArray(mem_ctx, 0x1c,
-								  PR_INTERNET_MESSAGE_ID,
-								  PR_INTERNET_MESSAGE_ID_UNICODE,
-								  PR_CONVERSATION_TOPIC,
-								  PR_CONVERSATION_TOPIC_UNICODE,
-								  PR_MESSAGE_DELIVERY_TIME,
-								  PR_MSG_EDITOR_FORMAT,
-								  PR_BODY,
-								  PR_BODY_UNICODE,
-								  PR_HTML,
-								  PR_RTF_COMPRESSED,
-								  PR_RTF_IN_SYNC,
-								  PR_SENT_REPRESENTING_NAME,
-								  PR_SENT_REPRESENTING_NAME_UNICODE,
-								  PR_DISPLAY_TO,
-								  PR_DISPLAY_TO_UNICODE,
-								  PR_DISPLAY_CC,
-								  PR_DISPLAY_CC_UNICODE,
-								  PR_DISPLAY_BCC,
-								  PR_DISPLAY_BCC_UNICODE,
-								  PR_HASATTACH,
-								  PR_TRANSPORT_MESSAGE_HEADERS,
-								  PR_SUBJECT_PREFIX,
-								  PR_SUBJECT_PREFIX_UNICODE,
-								  PR_NORMALIZED_SUBJECT,
-								  PR_NORMALIZED_SUBJECT_UNICODE,
-								  PR_SUBJECT,
-								  PR_SUBJECT_UNICODE,
-								  PR_ENTRYID);
-				retval = GetProps(&obj_message, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
-				MAPIFreeBuffer(SPropTagArray);
-				if (retval != MAPI_E_SUCCESS) {
-					fprintf(stderr, "Badness getting row %d attrs\n", i);
-					exit (1);
-				}
+	opts.profdb = opt_profdb;
+	opts.profname = opt_profname;
+	opts.password = opt_password;
+	opts.debug = opt_debug;
+	opts.dumpdata = opt_dumpdata;
+
+	if (opt_workers <= 1) {
+		session = logon(mem_ctx, &opts, &mapi_ctx);
+
+		/* do the updates now */
+		if (opt_update == true) {
+			retval = update(mem_ctx, fp, session);
+			if (retval != MAPI_E_SUCCESS) {
+				printf("Problem encountered during update: %d\n", retval);
+				exit (1);
+			}
+		}
 
-				/* Build a SRow structure */
-				aRow.ulAdrEntryPad = 0;
-				aRow.cValues = count;
-				aRow.lpProps = lpProps;
-
-				msgid = (const char *) octool_get_propval(&aRow, PR_INTERNET_MESSAGE_ID);
-				if (msgid) {
-					retval = FindProfileAttr(profile, "Message-ID", msgid);
-					if (GetLastError() == MAPI_E_NOT_FOUND) {
-						bool ok;
-						
-						message_error = 0;
-						ok = message2mbox(mem_ctx, fp, &aRow, &obj_store, &obj_inbox, &obj_message, 0);
-						if (!ok) {
-							printf("Message-ID: %s error, not added to %s\n", msgid, profile->profname);
-						} else if (message_error) {
-							printf("Message-ID: %s error, ignoring\n", msgid);
-							fprintf(stderr, "Message-ID: %s error, ignoring message (check with OWA if you can, will retry next time)\n", msgid);
-						} else if (opt_test) {
-							printf("Message-ID: %s saved but not updated in %s\n", msgid, profile->profname);
-						} else if
-						(mapi_profile_add_string_attr(profile->mapi_ctx, profile->profname, "Message-ID", msgid) != MAPI_E_SUCCESS) {
-							mapi_errstr("mapi_profile_add_string_attr", GetLastError());
-						} else {
-							printf("Message-ID: %s added to profile %s\n", msgid, profile->profname);
-						}
-					} else {
-						printf("Message-ID: %s already in profile %s\n", msgid, profile->profname);
-					}
-				} else {
-					fprintf(stderr, "%s: message with no msgid cannot be downloaded\n", profile->profname);
-				}
-				talloc_free(lpProps);
-			} else {
-				fprintf(stderr, "could not open row %d: retval=%d GetLastError=%d\n", i, retval, GetLastError());
+		retval = export_inbox(mem_ctx, fp, session, 0, 1, sync);
+		if (retval == MAPI_E_SUCCESS && sync && !opt_test) {
+			if (!octool_sync_save(sync, opt_sync_state)) {
+				retval = MAPI_E_CALL_FAILED;
 			}
-			mapi_object_release(&obj_message);
-			errno = 0;
 		}
+		MAPIUninitialize(mapi_ctx);
+	} else {
+		/* Deletions are mirrored before the workers start, so that
+		   they do not export messages about to be deleted */
+		if (opt_update == true) {
+			session = logon(mem_ctx, &opts, &mapi_ctx);
+			retval = update(mem_ctx, fp, session);
+			if (retval != MAPI_E_SUCCESS) {
+				printf("Problem encountered during update: %d\n", retval);
+				exit (1);
+			}
+			MAPIUninitialize(mapi_ctx);
+		}
+
+		retval = export_inbox_parallel(mem_ctx, fp, opt_mbox, &opts, opt_workers);
 	}
 
 	fclose(fp);
-	mapi_object_release(&obj_table);
-	mapi_object_release(&obj_inbox);
-	mapi_object_release(&obj_store);
-	MAPIUninitialize(mapi_ctx);
-
 	talloc_free(mem_ctx);
 
-	return 0;
+	return retval ? 1 : 0;
 }
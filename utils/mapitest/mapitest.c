@@ -213,12 +213,20 @@ int main(int argc, const char *argv[])
 	char			*prof_tmp = NULL;
 	bool			opt_leak_report = false;
 	bool			opt_leak_report_full = false;
+	bool			opt_bench = false;
+	struct mapitest_bench	bench = { 10, 1, 1, MAPITEST_BENCH_TEXT };
+	const char		*opt_bench_format = NULL;
+	bool			opt_load = false;
+	struct mapitest_load	load = { 1, 60, 1000, MAPITEST_LOAD_MIX, MAPITEST_BENCH_TEXT };
 
 	enum { OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD,
 	       OPT_CONFIDENTIAL, OPT_OUTFILE, OPT_MAPI_CALLS,
 	       OPT_NO_SERVER, OPT_LIST_ALL, OPT_DUMP_DATA,
 	       OPT_DEBUG, OPT_COLOR, OPT_SUBUNIT, OPT_LEAK_REPORT,
-	       OPT_LEAK_REPORT_FULL };
+	       OPT_LEAK_REPORT_FULL, OPT_BENCH, OPT_BENCH_ITERATIONS,
+	       OPT_BENCH_WARMUP, OPT_BENCH_SESSIONS, OPT_BENCH_FORMAT,
+	       OPT_LOAD, OPT_LOAD_USERS, OPT_LOAD_DURATION,
+	       OPT_LOAD_THINK_TIME, OPT_LOAD_MIX };
 
 	struct poptOption long_options[] = {
 		POPT_AUTOHELP
@@ -238,6 +246,16 @@ int main(int argc, const char *argv[])
 		{ "debuglevel",      'd', POPT_ARG_STRING, NULL, OPT_DEBUG,            "set debug level", NULL },
 		{ "leak-report",       0, POPT_ARG_NONE,   NULL, OPT_LEAK_REPORT,      "enable talloc leak reporting on exit", NULL },
 		{ "leak-report-full",  0, POPT_ARG_NONE,   NULL, OPT_LEAK_REPORT_FULL, "enable full talloc leak reporting on exit", NULL },
+		{ "bench",             0, POPT_ARG_NONE,   NULL, OPT_BENCH,            "benchmark the tests instead of checking them", NULL },
+		{ "bench-iterations",  0, POPT_ARG_STRING, NULL, OPT_BENCH_ITERATIONS, "measured runs of each test per session (default: 10)", "N" },
+		{ "bench-warmup",      0, POPT_ARG_STRING, NULL, OPT_BENCH_WARMUP,     "unmeasured runs of each test per session (default: 1)", "N" },
+		{ "bench-sessions",    0, POPT_ARG_STRING, NULL, OPT_BENCH_SESSIONS,   "number of concurrent sessions (default: 1)", "N" },
+		{ "bench-format",      0, POPT_ARG_STRING, NULL, OPT_BENCH_FORMAT,     "benchmark and load report format: text, json or csv", "FORMAT" },
+		{ "load",              0, POPT_ARG_NONE,   NULL, OPT_LOAD,             "generate Outlook-like load instead of running the tests", NULL },
+		{ "load-users",        0, POPT_ARG_STRING, NULL, OPT_LOAD_USERS,       "number of simulated users (default: 1)", "N" },
+		{ "load-duration",     0, POPT_ARG_STRING, NULL, OPT_LOAD_DURATION,    "load run time in seconds (default: 60)", "SECONDS" },
+		{ "load-think-time",   0, POPT_ARG_STRING, NULL, OPT_LOAD_THINK_TIME,  "mean pause between operations in ms (default: 1000)", "MS" },
+		{ "load-mix",          0, POPT_ARG_STRING, NULL, OPT_LOAD_MIX,         "operation weights (default: " MAPITEST_LOAD_MIX ")", "MIX" },
 		POPT_OPENCHANGE_VERSION
 		{ NULL, 0, 0, NULL, 0, NULL, NULL }
 	};
@@ -302,6 +320,36 @@ int main(int argc, const char *argv[])
 			opt_leak_report_full = true;
 			talloc_enable_leak_report_full();
 			break;
+		case OPT_BENCH:
+			opt_bench = true;
+			break;
+		case OPT_BENCH_ITERATIONS:
+			bench.iterations = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_BENCH_WARMUP:
+			bench.warmup = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_BENCH_SESSIONS:
+			bench.sessions = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_BENCH_FORMAT:
+			opt_bench_format = poptGetOptArg(pc);
+			break;
+		case OPT_LOAD:
+			opt_load = true;
+			break;
+		case OPT_LOAD_USERS:
+			load.users = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_LOAD_DURATION:
+			load.duration = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_LOAD_THINK_TIME:
+			load.think_time = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_LOAD_MIX:
+			load.mix = poptGetOptArg(pc);
+			break;
 		}
 	}
 
@@ -313,6 +361,23 @@ int main(int argc, const char *argv[])
 		return -1;
 	}
 
+	if (opt_bench_format) {
+		if (!strcmp(opt_bench_format, "json")) {
+			bench.format = MAPITEST_BENCH_JSON;
+		} else if (!strcmp(opt_bench_format, "csv")) {
+			bench.format = MAPITEST_BENCH_CSV;
+		} else if (strcmp(opt_bench_format, "text")) {
+			fprintf(stderr, "Invalid benchmark format: %s\n", opt_bench_format);
+			return -1;
+		}
+		load.format = bench.format;
+	}
+
+	if (opt_bench && opt_load) {
+		fprintf(stderr, "bench and load can't be set at the same time\n");
+		return -1;
+	}
+
 	/* Initialize MAPI subsystem */
 	if (!opt_profdb) {
 		opt_profdb = talloc_asprintf(mem_ctx, DEFAULT_PROFDB, getenv("HOME"));
@@ -329,7 +394,10 @@ int main(int argc, const char *argv[])
 	mt.online = mapitest_get_server_info(&mt, opt_profname, opt_password,
 					     opt_dumpdata, opt_debug);
 
-	mapitest_print_headers(&mt);
+	/* The benchmark or load report is the only output */
+	if (!opt_bench && !opt_load) {
+		mapitest_print_headers(&mt);
+	}
 
 	/* Do not run any tests if we couldn't find a profile or if
 	 * server is offline and connection to server was implicitly
@@ -339,20 +407,24 @@ int main(int argc, const char *argv[])
 		return -2;
 	}
 
-	/* Run custom tests */
-	if (mt.cmdline_calls) {
+	if (opt_bench) {
+		num_tests_failed = mapitest_bench_run(&mt, &bench, opt_profdb, opt_password);
+	} else if (opt_load) {
+		num_tests_failed = mapitest_load_run(&mt, &load, opt_profdb, opt_password);
+	} else if (mt.cmdline_calls) {
+		/* Run custom tests */
 		struct mapitest_unit	*el;
 		
 		for (el = mt.cmdline_calls; el; el = el->next) {
 			printf("[*] %s\n", el->name);
 			mapitest_run_test(&mt, el->name);
 		}
+		num_tests_failed = mapitest_stat_dump(&mt);
 	} else {
 		mapitest_run_all(&mt);
+		num_tests_failed = mapitest_stat_dump(&mt);
 	}
 
-	num_tests_failed = mapitest_stat_dump(&mt);
-
 	mapitest_cleanup_stream(&mt);
 
 	/* Uninitialize and free memory */
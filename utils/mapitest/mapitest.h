@@ -32,6 +32,8 @@
 /* forward declaration */
 struct mapitest;
 struct mapitest_suite;
+struct mapitest_bench;
+struct mapitest_load;
 
 
 /**
@@ -163,6 +165,36 @@ struct mapitest {
 	void			*priv;
 };
 
+/**
+	Output formats of the %mapitest benchmark report
+*/
+enum mapitest_bench_format {
+	MAPITEST_BENCH_TEXT,		/*!< Human readable table */
+	MAPITEST_BENCH_JSON,		/*!< JSON document */
+	MAPITEST_BENCH_CSV		/*!< CSV with a header line */
+};
+
+/**
+	Parameters of a %mapitest benchmark run
+*/
+struct mapitest_bench {
+	uint32_t			iterations;	/*!< Measured runs of each test per session */
+	uint32_t			warmup;		/*!< Unmeasured runs of each test per session */
+	uint32_t			sessions;	/*!< Number of concurrent sessions */
+	enum mapitest_bench_format	format;		/*!< Report format */
+};
+
+/**
+	Parameters of a %mapitest load generator run
+*/
+struct mapitest_load {
+	uint32_t			users;		/*!< Number of simulated users */
+	uint32_t			duration;	/*!< Run time in seconds */
+	uint32_t			think_time;	/*!< Mean pause between operations in ms */
+	const char			*mix;		/*!< Operation weights, name:weight[,...] */
+	enum mapitest_bench_format	format;		/*!< Report format */
+};
+
 struct mapitest_module {
 	char			*name;
 	
@@ -215,6 +247,8 @@ struct mt_common_tf_ctx
 #define	MT_MAIL_ATTACH		"Attach1.txt"
 #define	MT_MAIL_ATTACH2		"Attach2.txt"
 
+#define	MAPITEST_LOAD_MIX	"logon:1,hierarchy:2,contents:4,scroll:10,notify:20,submit:2"
+
 #define	MODULE_TITLE		"[MODULE] %s\n"
 #define	MODULE_TITLE_DELIM	'#'
 #define	MODULE_TITLE_NEWLINE	2
@@ -0,0 +1,491 @@
+/*
+   Stand-alone MAPI testsuite
+
+   OpenChange Project - benchmark mode
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/mapitest/mapitest.h"
+
+#include "config.h"
+
+#include <time.h>
+
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
+/**
+	\file
+	Benchmark mode for %mapitest: run tests repeatedly and report
+	their latency distribution and throughput
+*/
+
+/**
+   One selected test
+ */
+struct mapitest_bench_entry {
+	struct mapitest_suite	*suite;
+	struct mapitest_test	*test;
+};
+
+/**
+   One benchmark session: its own MAPI context, logon and samples
+ */
+struct mapitest_bench_session {
+	struct mapitest				mt;
+	const struct mapitest_bench		*bench;
+	struct mapitest_test			*test;
+	double					*samples;
+	uint32_t				failures;
+#if defined(HAVE_PTHREADS)
+	pthread_t				thread;
+	pthread_barrier_t			*barrier;
+#endif
+};
+
+/**
+   Results for one test
+ */
+struct mapitest_bench_result {
+	const char	*name;
+	uint32_t	count;
+	uint32_t	failures;
+	double		p50;
+	double		p95;
+	double		p99;
+	double		ops;
+};
+
+static double mapitest_bench_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int mapitest_bench_cmp(const void *a, const void *b)
+{
+	double	x = *(const double *)a;
+	double	y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted samples */
+static double mapitest_bench_percentile(const double *samples, uint32_t count, uint32_t p)
+{
+	uint64_t	rank;
+
+	if (!count) return 0.0;
+
+	rank = ((uint64_t)p * count + 99) / 100;
+	if (rank < 1) rank = 1;
+	return samples[rank - 1];
+}
+
+static bool mapitest_bench_run_once(struct mapitest_bench_session *s)
+{
+	bool	(*fn)(struct mapitest *);
+
+	errno = 0;
+	fn = s->test->fn;
+	return fn(&s->mt);
+}
+
+static void mapitest_bench_warmup(struct mapitest_bench_session *s)
+{
+	uint32_t	i;
+
+	for (i = 0; i < s->bench->warmup; i++) {
+		mapitest_bench_run_once(s);
+	}
+}
+
+static void mapitest_bench_measure(struct mapitest_bench_session *s)
+{
+	uint32_t	i;
+	double		start;
+	bool		ret;
+
+	for (i = 0; i < s->bench->iterations; i++) {
+		start = mapitest_bench_now();
+		ret = mapitest_bench_run_once(s);
+		s->samples[i] = (mapitest_bench_now() - start) * 1000.0;
+		if (ret == ((s->test->flags & ExpectedFail) != 0)) {
+			s->failures++;
+		}
+	}
+}
+
+#if defined(HAVE_PTHREADS)
+static void *mapitest_bench_thread(void *arg)
+{
+	struct mapitest_bench_session	*s = (struct mapitest_bench_session *) arg;
+
+	mapitest_bench_warmup(s);
+	/* measure every session over the same period */
+	pthread_barrier_wait(s->barrier);
+	mapitest_bench_measure(s);
+
+	return NULL;
+}
+#endif
+
+/**
+   Open one benchmark session. Each one gets its own MAPI context
+   since a context must only be used by one thread at a time.
+ */
+static bool mapitest_bench_session_open(struct mapitest *mt, struct mapitest_bench_session *s,
+					const char *profdb, const char *password)
+{
+	enum MAPISTATUS		retval;
+
+	memcpy(&s->mt, mt, sizeof (struct mapitest));
+	s->mt.mem_ctx = talloc_named(NULL, 0, "mapitest_bench_session");
+	s->mt.mapi_ctx = NULL;
+	s->mt.session = NULL;
+	s->mt.priv = NULL;
+	s->mt.stream = fopen("/dev/null", "w");
+	if (!s->mt.stream) {
+		talloc_free(s->mt.mem_ctx);
+		return false;
+	}
+
+	retval = MAPIInitialize(&s->mt.mapi_ctx, profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", retval);
+		goto fail;
+	}
+
+	retval = MapiLogonEx(s->mt.mapi_ctx, &s->mt.session, mt->profile->profname, password);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MapiLogonEx", retval);
+		MAPIUninitialize(s->mt.mapi_ctx);
+		goto fail;
+	}
+	s->mt.profile = s->mt.session->profile;
+
+	return true;
+
+fail:
+	fclose(s->mt.stream);
+	talloc_free(s->mt.mem_ctx);
+	return false;
+}
+
+static void mapitest_bench_session_close(struct mapitest_bench_session *s)
+{
+	MAPIUninitialize(s->mt.mapi_ctx);
+	fclose(s->mt.stream);
+	talloc_free(s->mt.mem_ctx);
+}
+
+static bool mapitest_bench_suite_runnable(struct mapitest *mt, struct mapitest_suite *suite)
+{
+	return ((mt->online == suite->online) && mt->session) || (suite->online == false);
+}
+
+static void mapitest_bench_add(TALLOC_CTX *mem_ctx, struct mapitest_bench_entry **entries,
+			       uint32_t *count, struct mapitest_suite *suite,
+			       struct mapitest_test *test)
+{
+	*entries = talloc_realloc(mem_ctx, *entries, struct mapitest_bench_entry, *count + 1);
+	(*entries)[*count].suite = suite;
+	(*entries)[*count].test = test;
+	(*count)++;
+}
+
+/**
+   Resolve the tests to benchmark: the --mapi-calls names (including
+   SUITE-ALL) or every runnable test
+ */
+static bool mapitest_bench_select(struct mapitest *mt, TALLOC_CTX *mem_ctx,
+				  struct mapitest_bench_entry **entries, uint32_t *count)
+{
+	struct mapitest_unit	*unit;
+	struct mapitest_suite	*suite;
+	struct mapitest_test	*el;
+	const char		*dash;
+	bool			found;
+
+	*entries = NULL;
+	*count = 0;
+
+	if (!mt->cmdline_calls) {
+		for (suite = mt->mapi_suite; suite; suite = suite->next) {
+			if (!mapitest_bench_suite_runnable(mt, suite)) continue;
+			for (el = suite->tests; el; el = el->next) {
+				mapitest_bench_add(mem_ctx, entries, count, suite, el);
+			}
+		}
+		return true;
+	}
+
+	for (unit = mt->cmdline_calls; unit; unit = unit->next) {
+		found = false;
+		dash = strrchr(unit->name, '-');
+		for (suite = mt->mapi_suite; suite; suite = suite->next) {
+			if (dash && !strcmp(dash, "-ALL") &&
+			    strlen(suite->name) == (size_t)(dash - unit->name) &&
+			    !strncmp(suite->name, unit->name, dash - unit->name)) {
+				found = true;
+				if (!mapitest_bench_suite_runnable(mt, suite)) break;
+				for (el = suite->tests; el; el = el->next) {
+					mapitest_bench_add(mem_ctx, entries, count, suite, el);
+				}
+				break;
+			}
+			for (el = suite->tests; el; el = el->next) {
+				if (!strcmp(el->name, unit->name)) break;
+			}
+			if (el) {
+				found = true;
+				if (mapitest_bench_suite_runnable(mt, suite)) {
+					mapitest_bench_add(mem_ctx, entries, count, suite, el);
+				} else {
+					fprintf(stderr, "Server is offline, skipping test: \"%s\"\n", unit->name);
+				}
+				break;
+			}
+		}
+		if (!found) {
+			fprintf(stderr, "[ERROR] Unknown test: \"%s\"\n", unit->name);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+   Run one test on every session and compute its statistics
+ */
+static bool mapitest_bench_test(struct mapitest_bench_session *sessions,
+				const struct mapitest_bench *bench,
+				struct mapitest_test *test,
+				double *samples,
+				struct mapitest_bench_result *result)
+{
+	uint32_t		i;
+	uint32_t		count = bench->sessions * bench->iterations;
+	double			start;
+	double			elapsed;
+#if defined(HAVE_PTHREADS)
+	pthread_barrier_t	barrier;
+#endif
+
+	for (i = 0; i < bench->sessions; i++) {
+		sessions[i].test = test;
+		sessions[i].samples = samples + i * bench->iterations;
+		sessions[i].failures = 0;
+	}
+
+	if (bench->sessions == 1) {
+		mapitest_bench_warmup(&sessions[0]);
+		start = mapitest_bench_now();
+		mapitest_bench_measure(&sessions[0]);
+		elapsed = mapitest_bench_now() - start;
+	} else {
+#if defined(HAVE_PTHREADS)
+		pthread_barrier_init(&barrier, NULL, bench->sessions + 1);
+		for (i = 0; i < bench->sessions; i++) {
+			sessions[i].barrier = &barrier;
+			if (pthread_create(&sessions[i].thread, NULL, mapitest_bench_thread, &sessions[i])) {
+				/* the barrier can no longer be reached, nothing to unwind */
+				err(errno, "pthread_create");
+			}
+		}
+		pthread_barrier_wait(&barrier);
+		start = mapitest_bench_now();
+		for (i = 0; i < bench->sessions; i++) {
+			pthread_join(sessions[i].thread, NULL);
+		}
+		elapsed = mapitest_bench_now() - start;
+		pthread_barrier_destroy(&barrier);
+#else
+		return false;
+#endif
+	}
+
+	result->name = test->name;
+	result->count = count;
+	result->failures = 0;
+	for (i = 0; i < bench->sessions; i++) {
+		result->failures += sessions[i].failures;
+	}
+
+	qsort(samples, count, sizeof (double), mapitest_bench_cmp);
+	result->p50 = mapitest_bench_percentile(samples, count, 50);
+	result->p95 = mapitest_bench_percentile(samples, count, 95);
+	result->p99 = mapitest_bench_percentile(samples, count, 99);
+	result->ops = (elapsed > 0.0) ? count / elapsed : 0.0;
+
+	return true;
+}
+
+static void mapitest_bench_print_json_string(FILE *stream, const char *str)
+{
+	fputc('"', stream);
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\') {
+			fputc('\\', stream);
+		}
+		fputc(*str, stream);
+	}
+	fputc('"', stream);
+}
+
+static void mapitest_bench_report(FILE *stream, const struct mapitest_bench *bench,
+				  const struct mapitest_bench_result *results, uint32_t count)
+{
+	uint32_t	i;
+
+	switch (bench->format) {
+	case MAPITEST_BENCH_JSON:
+		fprintf(stream, "{\n  \"iterations\": %u,\n  \"warmup\": %u,\n  \"sessions\": %u,\n  \"tests\": [\n",
+			bench->iterations, bench->warmup, bench->sessions);
+		for (i = 0; i < count; i++) {
+			fprintf(stream, "    { \"name\": ");
+			mapitest_bench_print_json_string(stream, results[i].name);
+			fprintf(stream, ", \"samples\": %u, \"failures\": %u, \"p50_ms\": %.3f, "
+				"\"p95_ms\": %.3f, \"p99_ms\": %.3f, \"ops_per_sec\": %.2f }%s\n",
+				results[i].count, results[i].failures, results[i].p50,
+				results[i].p95, results[i].p99, results[i].ops,
+				(i + 1 < count) ? "," : "");
+		}
+		fprintf(stream, "  ]\n}\n");
+		break;
+	case MAPITEST_BENCH_CSV:
+		fprintf(stream, "name,samples,failures,p50_ms,p95_ms,p99_ms,ops_per_sec\n");
+		for (i = 0; i < count; i++) {
+			fprintf(stream, "%s,%u,%u,%.3f,%.3f,%.3f,%.2f\n",
+				results[i].name, results[i].count, results[i].failures,
+				results[i].p50, results[i].p95, results[i].p99, results[i].ops);
+		}
+		break;
+	default:
+		fprintf(stream, MT_HDR_START);
+		fprintf(stream, "[*] %u iterations, %u warmup, %u session(s)\n",
+			bench->iterations, bench->warmup, bench->sessions);
+		fprintf(stream, "%-40s %8s %8s %10s %10s %10s %10s\n", "test", "samples",
+			"failed", "p50 (ms)", "p95 (ms)", "p99 (ms)", "ops/s");
+		for (i = 0; i < count; i++) {
+			fprintf(stream, "%-40s %8u %8u %10.3f %10.3f %10.3f %10.2f\n",
+				results[i].name, results[i].count, results[i].failures,
+				results[i].p50, results[i].p95, results[i].p99, results[i].ops);
+		}
+		fprintf(stream, MT_HDR_END);
+		break;
+	}
+	fflush(stream);
+}
+
+/**
+   \details Benchmark the selected tests
+
+   Each selected test is run bench->warmup times unmeasured, then
+   bench->iterations times measured, on each of bench->sessions
+   sessions. Sessions run concurrently, one thread per session, each
+   with its own MAPI context and logon. Test output is discarded; the
+   report is written to mt->stream in the requested format.
+
+   \param mt pointer to the top-level mapitest structure
+   \param bench the benchmark parameters
+   \param profdb the profile database path
+   \param password the profile password
+
+   \return the number of tests which failed at least once, -1 on error
+ */
+_PUBLIC_ int mapitest_bench_run(struct mapitest *mt, const struct mapitest_bench *bench,
+				const char *profdb, const char *password)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct mapitest_bench_entry	*entries;
+	struct mapitest_bench_session	*sessions;
+	struct mapitest_bench_result	*results;
+	double				*samples;
+	uint32_t			count;
+	uint32_t			opened;
+	uint32_t			done;
+	uint32_t			i;
+	int				failed = 0;
+
+	if (!bench->iterations || !bench->sessions) {
+		fprintf(stderr, "[ERROR] iterations and sessions must be greater than 0\n");
+		return -1;
+	}
+#if !defined(HAVE_PTHREADS)
+	if (bench->sessions > 1) {
+		fprintf(stderr, "[ERROR] concurrent sessions require thread support\n");
+		return -1;
+	}
+#endif
+	if (bench->sessions > 1 && !mt->session) {
+		fprintf(stderr, "[ERROR] concurrent sessions require a server connection\n");
+		return -1;
+	}
+
+	mem_ctx = talloc_named(NULL, 0, "mapitest_bench_run");
+
+	if (!mapitest_bench_select(mt, mem_ctx, &entries, &count)) {
+		talloc_free(mem_ctx);
+		return -1;
+	}
+
+	sessions = talloc_zero_array(mem_ctx, struct mapitest_bench_session, bench->sessions);
+	results = talloc_zero_array(mem_ctx, struct mapitest_bench_result, count ? count : 1);
+	samples = talloc_array(mem_ctx, double, bench->sessions * bench->iterations);
+
+	/* the first session is the main logon, the others get their own */
+	memcpy(&sessions[0].mt, mt, sizeof (struct mapitest));
+	sessions[0].mt.stream = fopen("/dev/null", "w");
+	if (!sessions[0].mt.stream) {
+		talloc_free(mem_ctx);
+		return -1;
+	}
+	for (opened = 1; opened < bench->sessions; opened++) {
+		if (!mapitest_bench_session_open(mt, &sessions[opened], profdb, password)) {
+			failed = -1;
+			break;
+		}
+	}
+
+	done = 0;
+	if (failed == 0) {
+		for (i = 0; i < bench->sessions; i++) {
+			sessions[i].bench = bench;
+		}
+		for (i = 0; i < count; i++) {
+			if (!mapitest_suite_test_is_applicable(mt, entries[i].test)) continue;
+			if (!mapitest_bench_test(sessions, bench, entries[i].test, samples, &results[done])) {
+				failed = -1;
+				break;
+			}
+			if (results[done].failures) failed++;
+			done++;
+		}
+		mapitest_bench_report(mt->stream, bench, results, done);
+	}
+
+	for (i = 1; i < opened; i++) {
+		mapitest_bench_session_close(&sessions[i]);
+	}
+	fclose(sessions[0].mt.stream);
+	talloc_free(mem_ctx);
+
+	return failed;
+}
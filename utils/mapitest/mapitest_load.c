@@ -0,0 +1,726 @@
+/*
+   Stand-alone MAPI testsuite
+
+   OpenChange Project - load generator
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "utils/mapitest/mapitest.h"
+#include "utils/openchange-tools.h"
+
+#include "config.h"
+
+#include <time.h>
+
+#if defined(HAVE_PTHREADS)
+#include <pthread.h>
+#endif
+
+/**
+	\file
+	Load generator for %mapitest: simulated users repeat the
+	operations an Outlook client does against its mailbox, in a
+	configurable mix and with think times between them, and the
+	latency distribution and throughput of each operation is reported
+*/
+
+#define	MAPITEST_LOAD_SUBJECT		"[MT] load generator"
+#define	MAPITEST_LOAD_PAGE		25
+#define	MAPITEST_LOAD_SCROLL_PAGES	4
+
+struct mapitest_load_user;
+
+/**
+   One simulated client operation
+ */
+struct mapitest_load_action {
+	const char	*name;
+	bool		(*fn)(struct mapitest_load_user *);
+};
+
+/**
+   Samples of one operation for one user
+ */
+struct mapitest_load_samples {
+	double		*values;
+	uint32_t	count;
+	uint32_t	size;
+	uint32_t	failures;
+};
+
+static bool mapitest_load_logon(struct mapitest_load_user *);
+static bool mapitest_load_hierarchy(struct mapitest_load_user *);
+static bool mapitest_load_contents(struct mapitest_load_user *);
+static bool mapitest_load_scroll(struct mapitest_load_user *);
+static bool mapitest_load_notify(struct mapitest_load_user *);
+static bool mapitest_load_submit(struct mapitest_load_user *);
+
+static const struct mapitest_load_action mapitest_load_actions[] = {
+	{ "logon",	mapitest_load_logon },
+	{ "hierarchy",	mapitest_load_hierarchy },
+	{ "contents",	mapitest_load_contents },
+	{ "scroll",	mapitest_load_scroll },
+	{ "notify",	mapitest_load_notify },
+	{ "submit",	mapitest_load_submit }
+};
+
+#define	MAPITEST_LOAD_ACTIONS	(sizeof (mapitest_load_actions) / sizeof (mapitest_load_actions[0]))
+
+/**
+   One simulated user: its own MAPI context, logon, folders and samples
+ */
+struct mapitest_load_user {
+	struct mapitest				mt;
+	TALLOC_CTX				*mem_ctx;
+	const struct mapitest_load		*load;
+	const uint32_t				*weights;
+	uint32_t				weight_total;
+	const char				*password;
+	unsigned int				seed;
+	double					deadline;
+	mapi_object_t				obj_store;
+	mapi_object_t				obj_inbox;
+	mapi_object_t				obj_outbox;
+	struct octool_sync			*sync;
+	uint32_t				notifications;
+	bool					subscribed;
+	struct mapitest_load_samples		samples[MAPITEST_LOAD_ACTIONS];
+#if defined(HAVE_PTHREADS)
+	pthread_t				thread;
+	pthread_barrier_t			*barrier;
+#endif
+};
+
+static double mapitest_load_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int mapitest_load_cmp(const void *a, const void *b)
+{
+	double	x = *(const double *)a;
+	double	y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* nearest-rank percentile of sorted samples */
+static double mapitest_load_percentile(const double *samples, uint32_t count, uint32_t p)
+{
+	uint64_t	rank;
+
+	if (!count) return 0.0;
+
+	rank = ((uint64_t)p * count + 99) / 100;
+	if (rank < 1) rank = 1;
+	return samples[rank - 1];
+}
+
+/**
+   Parse the operation mix: comma separated name:weight pairs.
+   Operations left out are not run.
+ */
+static bool mapitest_load_parse_mix(const char *mix, uint32_t *weights, uint32_t *total)
+{
+	char		*str, *tok, *saveptr = NULL;
+	char		*colon, *end;
+	unsigned long	weight;
+	uint32_t	i;
+	bool		ret = true;
+
+	memset(weights, 0, MAPITEST_LOAD_ACTIONS * sizeof (uint32_t));
+	*total = 0;
+
+	str = strdup(mix);
+	if (!str) return false;
+
+	for (tok = strtok_r(str, ",", &saveptr); tok; tok = strtok_r(NULL, ",", &saveptr)) {
+		colon = strchr(tok, ':');
+		if (colon) {
+			*colon = '\0';
+			weight = strtoul(colon + 1, &end, 10);
+			if (*end || end == colon + 1) {
+				fprintf(stderr, "[ERROR] Invalid weight for \"%s\" in the load mix\n", tok);
+				ret = false;
+				break;
+			}
+		} else {
+			weight = 1;
+		}
+		for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+			if (!strcmp(tok, mapitest_load_actions[i].name)) break;
+		}
+		if (i == MAPITEST_LOAD_ACTIONS) {
+			fprintf(stderr, "[ERROR] Unknown load operation: \"%s\"\n", tok);
+			ret = false;
+			break;
+		}
+		weights[i] = weight;
+	}
+	free(str);
+
+	for (i = 0; ret && i < MAPITEST_LOAD_ACTIONS; i++) {
+		*total += weights[i];
+	}
+	if (ret && !*total) {
+		fprintf(stderr, "[ERROR] The load mix has no operation to run\n");
+		ret = false;
+	}
+
+	return ret;
+}
+
+/*
+ * Simulated operations. Each one returns false on failure, the
+ * latency of the whole call sequence is what gets measured.
+ */
+
+/* A client starting up: a new logon and its private store */
+static bool mapitest_load_logon(struct mapitest_load_user *u)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_session	*session = NULL;
+	mapi_object_t		obj_store;
+
+	retval = MapiLogonEx(u->mt.mapi_ctx, &session, u->mt.profile->profname, u->password);
+	if (retval != MAPI_E_SUCCESS) return false;
+
+	mapi_object_init(&obj_store);
+	retval = OpenMsgStore(session, &obj_store);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_object_release(&obj_store);
+		return false;
+	}
+
+	/* Logoff drops the session and releases the store */
+	return (Logoff(&obj_store) == MAPI_E_SUCCESS);
+}
+
+/* Folder list download, as done when the cached mode client starts */
+static bool mapitest_load_hierarchy(struct mapitest_load_user *u)
+{
+	enum MAPISTATUS		retval;
+	TALLOC_CTX		*mem_ctx;
+	mapi_object_t		obj_sync;
+	mapi_id_t		id_folder;
+	mapi_object_t		obj_folder;
+	struct SPropTagArray	*SPropTagArray;
+	enum TransferStatus	status;
+	uint16_t		progress;
+	uint16_t		total;
+	DATA_BLOB		restriction;
+	DATA_BLOB		buffer;
+
+	retval = GetDefaultFolder(&u->obj_store, &id_folder, olFolderTopInformationStore);
+	if (retval != MAPI_E_SUCCESS) return false;
+
+	mem_ctx = talloc_named(u->mem_ctx, 0, "mapitest_load_hierarchy");
+	mapi_object_init(&obj_folder);
+	mapi_object_init(&obj_sync);
+
+	retval = OpenFolder(&u->obj_store, id_folder, &obj_folder);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x0);
+	restriction = data_blob_null;
+	retval = ICSSyncConfigure(&obj_folder, Hierarchy, FastTransfer_Unicode,
+				  SynchronizationFlag_Unicode | SynchronizationFlag_NoForeignIdentifiers,
+				  Eid | Cn, restriction, SPropTagArray, &obj_sync);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	do {
+		retval = FXGetBuffer(&obj_sync, 0, &status, &progress, &total, &buffer);
+		if (retval != MAPI_E_SUCCESS) goto end;
+		if (status == TransferStatus_Error) {
+			retval = MAPI_E_CALL_FAILED;
+			goto end;
+		}
+	} while (status != TransferStatus_Done);
+
+end:
+	mapi_object_release(&obj_sync);
+	mapi_object_release(&obj_folder);
+	talloc_free(mem_ctx);
+
+	return (retval == MAPI_E_SUCCESS);
+}
+
+/* Incremental inbox synchronization, the state is kept between runs */
+static bool mapitest_load_contents(struct mapitest_load_user *u)
+{
+	return (octool_sync_contents(&u->obj_inbox, u->sync) == MAPI_E_SUCCESS);
+}
+
+/* Inbox view: a few pages of the columns an Outlook list view shows */
+static bool mapitest_load_scroll(struct mapitest_load_user *u)
+{
+	enum MAPISTATUS		retval;
+	mapi_object_t		obj_table;
+	struct SPropTagArray	*SPropTagArray;
+	struct SRowSet		SRowSet;
+	uint32_t		count;
+	uint32_t		i;
+
+	mapi_object_init(&obj_table);
+	retval = GetContentsTable(&u->obj_inbox, &obj_table, 0, &count);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	SPropTagArray = set_SPropTagArray(u->mem_ctx, 0x8,
+					  PR_MID,
+					  PR_SUBJECT_UNICODE,
+					  PR_SENDER_NAME_UNICODE,
+					  PR_MESSAGE_DELIVERY_TIME,
+					  PR_MESSAGE_FLAGS,
+					  PR_MESSAGE_SIZE,
+					  PR_HASATTACH,
+					  PR_IMPORTANCE);
+	retval = SetColumns(&obj_table, SPropTagArray);
+	MAPIFreeBuffer(SPropTagArray);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	for (i = 0; i < MAPITEST_LOAD_SCROLL_PAGES; i++) {
+		retval = QueryRows(&obj_table, MAPITEST_LOAD_PAGE, TBL_ADVANCE, TBL_FORWARD_READ, &SRowSet);
+		if (retval == MAPI_E_NOT_FOUND) {
+			retval = MAPI_E_SUCCESS;
+			break;
+		}
+		if (retval != MAPI_E_SUCCESS) goto end;
+		if (SRowSet.cRows < MAPITEST_LOAD_PAGE) break;
+	}
+
+end:
+	mapi_object_release(&obj_table);
+
+	return (retval == MAPI_E_SUCCESS);
+}
+
+static int mapitest_load_newmail(uint16_t type, void *data, void *priv)
+{
+	struct mapitest_load_user	*u = (struct mapitest_load_user *) priv;
+
+	u->notifications++;
+
+	return 0;
+}
+
+/* Notification poll, what an idle client keeps doing */
+static bool mapitest_load_notify(struct mapitest_load_user *u)
+{
+	if (!u->subscribed) return false;
+
+	return (DispatchNotifications(u->mt.session) == MAPI_E_SUCCESS);
+}
+
+/* A mail sent to oneself from the outbox */
+static bool mapitest_load_submit(struct mapitest_load_user *u)
+{
+	mapi_object_t	obj_message;
+	bool		ret;
+
+	mapi_object_init(&obj_message);
+	ret = mapitest_common_message_create(&u->mt, &u->obj_outbox, &obj_message, MAPITEST_LOAD_SUBJECT);
+	if (ret) {
+		ret = (SubmitMessage(&obj_message) == MAPI_E_SUCCESS);
+	}
+	mapi_object_release(&obj_message);
+
+	return ret;
+}
+
+static uint32_t mapitest_load_pick(struct mapitest_load_user *u)
+{
+	uint32_t	r;
+	uint32_t	i;
+
+	r = rand_r(&u->seed) % u->weight_total;
+	for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+		if (r < u->weights[i]) break;
+		r -= u->weights[i];
+	}
+
+	return i;
+}
+
+static void mapitest_load_record(struct mapitest_load_user *u, uint32_t action, double ms, bool ret)
+{
+	struct mapitest_load_samples	*s = &u->samples[action];
+
+	if (!ret) s->failures++;
+	if (s->count == s->size) {
+		s->size = s->size ? s->size * 2 : 64;
+		s->values = talloc_realloc(u->mem_ctx, s->values, double, s->size);
+	}
+	s->values[s->count++] = ms;
+}
+
+/* think time drawn uniformly in [0, 2 * think_time] ms */
+static void mapitest_load_think(struct mapitest_load_user *u)
+{
+	double		wait;
+	double		left;
+
+	if (!u->load->think_time) return;
+
+	wait = (rand_r(&u->seed) % (2 * u->load->think_time + 1)) / 1000.0;
+	left = u->deadline - mapitest_load_now();
+	if (wait > left) wait = left;
+	if (wait > 0.0) {
+		usleep(wait * 1e6);
+	}
+}
+
+static void mapitest_load_loop(struct mapitest_load_user *u)
+{
+	uint32_t	action;
+	double		start;
+	bool		ret;
+
+	u->deadline = mapitest_load_now() + u->load->duration;
+	/* spread the users instead of starting them in lockstep */
+	mapitest_load_think(u);
+
+	while (mapitest_load_now() < u->deadline) {
+		action = mapitest_load_pick(u);
+		errno = 0;
+		start = mapitest_load_now();
+		ret = mapitest_load_actions[action].fn(u);
+		mapitest_load_record(u, action, (mapitest_load_now() - start) * 1000.0, ret);
+		mapitest_load_think(u);
+	}
+}
+
+#if defined(HAVE_PTHREADS)
+static void *mapitest_load_thread(void *arg)
+{
+	struct mapitest_load_user	*u = (struct mapitest_load_user *) arg;
+
+	pthread_barrier_wait(u->barrier);
+	mapitest_load_loop(u);
+
+	return NULL;
+}
+#endif
+
+/**
+   Log a simulated user on. Each one gets its own MAPI context since a
+   context must only be used by one thread at a time.
+ */
+static bool mapitest_load_user_open(struct mapitest *mt, struct mapitest_load_user *u,
+				    const char *profdb, const char *password)
+{
+	enum MAPISTATUS		retval;
+	uint32_t		connection;
+
+	memcpy(&u->mt, mt, sizeof (struct mapitest));
+	u->mem_ctx = talloc_named(NULL, 0, "mapitest_load_user");
+	u->mt.mem_ctx = u->mem_ctx;
+	u->mt.mapi_ctx = NULL;
+	u->mt.session = NULL;
+	u->mt.priv = NULL;
+	u->password = password;
+	u->mt.stream = fopen("/dev/null", "w");
+	if (!u->mt.stream) {
+		talloc_free(u->mem_ctx);
+		return false;
+	}
+
+	retval = MAPIInitialize(&u->mt.mapi_ctx, profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", retval);
+		goto fail;
+	}
+
+	retval = MapiLogonEx(u->mt.mapi_ctx, &u->mt.session, mt->profile->profname, password);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MapiLogonEx", retval);
+		goto fail_uninit;
+	}
+	u->mt.profile = u->mt.session->profile;
+
+	mapi_object_init(&u->obj_store);
+	mapi_object_init(&u->obj_inbox);
+	mapi_object_init(&u->obj_outbox);
+
+	retval = OpenMsgStore(u->mt.session, &u->obj_store);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("OpenMsgStore", retval);
+		goto fail_uninit;
+	}
+	if (!mapitest_common_folder_open(&u->mt, &u->obj_store, &u->obj_inbox, olFolderInbox) ||
+	    !mapitest_common_folder_open(&u->mt, &u->obj_store, &u->obj_outbox, olFolderOutbox)) {
+		fprintf(stderr, "[ERROR] Unable to open the inbox and outbox folders\n");
+		goto fail_uninit;
+	}
+
+	u->sync = talloc_zero(u->mem_ctx, struct octool_sync);
+
+	/* A failed subscription only fails the notify operations */
+	if (RegisterNotification(u->mt.session) == MAPI_E_SUCCESS) {
+		u->subscribed = (Subscribe(&u->obj_inbox, &connection, fnevNewMail, false,
+					   mapitest_load_newmail, u) == MAPI_E_SUCCESS);
+	}
+
+	return true;
+
+fail_uninit:
+	MAPIUninitialize(u->mt.mapi_ctx);
+fail:
+	fclose(u->mt.stream);
+	talloc_free(u->mem_ctx);
+	return false;
+}
+
+static void mapitest_load_user_close(struct mapitest_load_user *u)
+{
+	mapi_object_release(&u->obj_outbox);
+	mapi_object_release(&u->obj_inbox);
+	mapi_object_release(&u->obj_store);
+	MAPIUninitialize(u->mt.mapi_ctx);
+	fclose(u->mt.stream);
+	talloc_free(u->mem_ctx);
+}
+
+/**
+   Delete the mails the submit operations sent to the mailbox
+ */
+static void mapitest_load_cleanup(struct mapitest_load_user *u)
+{
+	mapi_object_t	obj_folder;
+
+	mapitest_common_message_delete_by_subject(&u->mt, &u->obj_inbox, MAPITEST_LOAD_SUBJECT);
+
+	mapi_object_init(&obj_folder);
+	if (mapitest_common_folder_open(&u->mt, &u->obj_store, &obj_folder, olFolderSentMail)) {
+		mapitest_common_message_delete_by_subject(&u->mt, &obj_folder, MAPITEST_LOAD_SUBJECT);
+	}
+	mapi_object_release(&obj_folder);
+}
+
+static void mapitest_load_report(FILE *stream, const struct mapitest_load *load,
+				 struct mapitest_load_user *users, double elapsed)
+{
+	TALLOC_CTX	*mem_ctx;
+	double		*samples;
+	uint32_t	count[MAPITEST_LOAD_ACTIONS];
+	uint32_t	failures[MAPITEST_LOAD_ACTIONS];
+	double		p50[MAPITEST_LOAD_ACTIONS];
+	double		p95[MAPITEST_LOAD_ACTIONS];
+	double		p99[MAPITEST_LOAD_ACTIONS];
+	uint32_t	notifications = 0;
+	uint32_t	total = 0;
+	uint32_t	n;
+	uint32_t	i, j;
+	bool		first;
+
+	mem_ctx = talloc_named(NULL, 0, "mapitest_load_report");
+
+	for (j = 0; j < load->users; j++) {
+		notifications += users[j].notifications;
+	}
+
+	for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+		count[i] = failures[i] = 0;
+		for (j = 0; j < load->users; j++) {
+			count[i] += users[j].samples[i].count;
+			failures[i] += users[j].samples[i].failures;
+		}
+		total += count[i];
+
+		samples = talloc_array(mem_ctx, double, count[i] ? count[i] : 1);
+		for (n = 0, j = 0; j < load->users; j++) {
+			memcpy(samples + n, users[j].samples[i].values,
+			       users[j].samples[i].count * sizeof (double));
+			n += users[j].samples[i].count;
+		}
+		qsort(samples, count[i], sizeof (double), mapitest_load_cmp);
+		p50[i] = mapitest_load_percentile(samples, count[i], 50);
+		p95[i] = mapitest_load_percentile(samples, count[i], 95);
+		p99[i] = mapitest_load_percentile(samples, count[i], 99);
+		talloc_free(samples);
+	}
+
+#define	MAPITEST_LOAD_OPS(c)	((elapsed > 0.0) ? (c) / elapsed : 0.0)
+
+	switch (load->format) {
+	case MAPITEST_BENCH_JSON:
+		fprintf(stream, "{\n  \"users\": %u,\n  \"duration\": %.2f,\n  \"think_time_ms\": %u,\n"
+			"  \"notifications\": %u,\n  \"ops_per_sec\": %.2f,\n  \"operations\": [\n",
+			load->users, elapsed, load->think_time, notifications, MAPITEST_LOAD_OPS(total));
+		first = true;
+		for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+			if (!count[i]) continue;
+			fprintf(stream, "%s    { \"name\": \"%s\", \"samples\": %u, \"failures\": %u, "
+				"\"p50_ms\": %.3f, \"p95_ms\": %.3f, \"p99_ms\": %.3f, \"ops_per_sec\": %.2f }",
+				first ? "" : ",\n", mapitest_load_actions[i].name, count[i], failures[i],
+				p50[i], p95[i], p99[i], MAPITEST_LOAD_OPS(count[i]));
+			first = false;
+		}
+		fprintf(stream, "\n  ]\n}\n");
+		break;
+	case MAPITEST_BENCH_CSV:
+		fprintf(stream, "name,samples,failures,p50_ms,p95_ms,p99_ms,ops_per_sec\n");
+		for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+			if (!count[i]) continue;
+			fprintf(stream, "%s,%u,%u,%.3f,%.3f,%.3f,%.2f\n",
+				mapitest_load_actions[i].name, count[i], failures[i],
+				p50[i], p95[i], p99[i], MAPITEST_LOAD_OPS(count[i]));
+		}
+		break;
+	default:
+		fprintf(stream, MT_HDR_START);
+		fprintf(stream, "[*] %u user(s), %.2f seconds, %u ms think time, %u new mail notification(s)\n",
+			load->users, elapsed, load->think_time, notifications);
+		fprintf(stream, "%-40s %8s %8s %10s %10s %10s %10s\n", "operation", "samples",
+			"failed", "p50 (ms)", "p95 (ms)", "p99 (ms)", "ops/s");
+		for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+			if (!count[i]) continue;
+			fprintf(stream, "%-40s %8u %8u %10.3f %10.3f %10.3f %10.2f\n",
+				mapitest_load_actions[i].name, count[i], failures[i],
+				p50[i], p95[i], p99[i], MAPITEST_LOAD_OPS(count[i]));
+		}
+		fprintf(stream, "%-40s %8u %8s %10s %10s %10s %10.2f\n", "total", total,
+			"", "", "", "", MAPITEST_LOAD_OPS(total));
+		fprintf(stream, MT_HDR_END);
+		break;
+	}
+	fflush(stream);
+
+#undef	MAPITEST_LOAD_OPS
+
+	talloc_free(mem_ctx);
+}
+
+/**
+   \details Generate Outlook-like load against the server
+
+   load->users simulated users log on with the profile, each in its
+   own thread with its own MAPI context, and for load->duration
+   seconds repeat operations drawn from load->mix: logons, folder
+   hierarchy and inbox contents synchronization, inbox table
+   scrolling, notification polls and mail submission. A random think
+   time averaging load->think_time milliseconds separates two
+   operations of a user. The report is written to mt->stream in the
+   requested format.
+
+   \param mt pointer to the top-level mapitest structure
+   \param load the load parameters
+   \param profdb the profile database path
+   \param password the profile password
+
+   \return the number of operations which failed at least once, -1 on
+   error
+ */
+_PUBLIC_ int mapitest_load_run(struct mapitest *mt, const struct mapitest_load *load,
+			       const char *profdb, const char *password)
+{
+	TALLOC_CTX			*mem_ctx;
+	struct mapitest_load_user	*users;
+	uint32_t			weights[MAPITEST_LOAD_ACTIONS];
+	uint32_t			weight_total;
+	uint32_t			opened;
+	uint32_t			i, j;
+	double				start;
+	double				elapsed = 0.0;
+	uint32_t			submitted = 0;
+	int				failed = 0;
+#if defined(HAVE_PTHREADS)
+	pthread_barrier_t		barrier;
+#endif
+
+	if (!load->users || !load->duration) {
+		fprintf(stderr, "[ERROR] users and duration must be greater than 0\n");
+		return -1;
+	}
+#if !defined(HAVE_PTHREADS)
+	if (load->users > 1) {
+		fprintf(stderr, "[ERROR] concurrent users require thread support\n");
+		return -1;
+	}
+#endif
+	if (!mt->session) {
+		fprintf(stderr, "[ERROR] the load generator requires a server connection\n");
+		return -1;
+	}
+	if (!mapitest_load_parse_mix(load->mix, weights, &weight_total)) {
+		return -1;
+	}
+
+	mem_ctx = talloc_named(NULL, 0, "mapitest_load_run");
+	users = talloc_zero_array(mem_ctx, struct mapitest_load_user, load->users);
+
+	for (opened = 0; opened < load->users; opened++) {
+		if (!mapitest_load_user_open(mt, &users[opened], profdb, password)) {
+			failed = -1;
+			break;
+		}
+		users[opened].load = load;
+		users[opened].weights = weights;
+		users[opened].weight_total = weight_total;
+		users[opened].seed = time(NULL) ^ (opened * 2654435761U);
+	}
+
+	if (failed == 0) {
+		if (load->users == 1) {
+			start = mapitest_load_now();
+			mapitest_load_loop(&users[0]);
+			elapsed = mapitest_load_now() - start;
+		} else {
+#if defined(HAVE_PTHREADS)
+			pthread_barrier_init(&barrier, NULL, load->users + 1);
+			for (i = 0; i < load->users; i++) {
+				users[i].barrier = &barrier;
+				if (pthread_create(&users[i].thread, NULL, mapitest_load_thread, &users[i])) {
+					/* the barrier can no longer be reached, nothing to unwind */
+					err(errno, "pthread_create");
+				}
+			}
+			pthread_barrier_wait(&barrier);
+			start = mapitest_load_now();
+			for (i = 0; i < load->users; i++) {
+				pthread_join(users[i].thread, NULL);
+			}
+			elapsed = mapitest_load_now() - start;
+			pthread_barrier_destroy(&barrier);
+#endif
+		}
+
+		mapitest_load_report(mt->stream, load, users, elapsed);
+
+		for (i = 0; i < MAPITEST_LOAD_ACTIONS; i++) {
+			for (j = 0; j < load->users; j++) {
+				if (users[j].samples[i].failures) break;
+			}
+			if (j < load->users) failed++;
+			if (mapitest_load_actions[i].fn != mapitest_load_submit) continue;
+			for (j = 0; j < load->users; j++) {
+				submitted += users[j].samples[i].count;
+			}
+		}
+
+		if (submitted) {
+			mapitest_load_cleanup(&users[0]);
+		}
+	}
+
+	for (i = 0; i < opened; i++) {
+		mapitest_load_user_close(&users[i]);
+	}
+	talloc_free(mem_ctx);
+
+	return failed;
+}
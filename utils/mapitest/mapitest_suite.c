@@ -220,7 +220,7 @@ static bool mapitest_suite_is_server_OpenChange(struct mapitest *mt)
    
    \return true if the test should be run, otherwise false
 */
-static bool mapitest_suite_test_is_applicable(struct mapitest *mt, struct mapitest_test *test)
+_PUBLIC_ bool mapitest_suite_test_is_applicable(struct mapitest *mt, struct mapitest_test *test)
 {
 	uint16_t actualServerVer = mt->info.rgwServerVersion[0];
 
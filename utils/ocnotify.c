@@ -76,7 +76,7 @@ static void ocnotify_newmail(TALLOC_CTX *mem_ctx, struct ocnotify_private ocnoti
 		exit (1);
 	}
 
-	retval = mapistore_notification_payload_newmail(mem_ctx, ocnotify.backend, (char *)data, ocnotify.dstfolder,
+	retval = mapistore_notification_payload_newmail(mem_ctx, (char *)ocnotify.username, ocnotify.backend, (char *)data, ocnotify.dstfolder,
 							ocnotify.sep, &blob, &msglen);
 	if (retval != MAPISTORE_SUCCESS) {
 		oc_log(OC_LOG_ERROR, "unable to generate newmail payload");
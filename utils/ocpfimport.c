@@ -0,0 +1,696 @@
+/*
+   Import OCPF files in bulk
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Files are parsed by a pool of threads, each with its own OCPF
+ * context, while the main thread alone uses the MAPI session: libmapi
+ * sessions cannot be shared between threads. Messages are created,
+ * set, saved and released in batches of ROPs sent in a single
+ * EMSMDB round-trip.
+ */
+
+#include "libmapi/libmapi.h"
+#include "libocpf/ocpf.h"
+#include <popt.h>
+#include <pthread.h>
+#include <ftw.h>
+
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <string.h>
+
+#include "openchange-tools.h"
+
+/*
+ * Number of messages imported in a single EMSMDB round-trip
+ */
+#define	OCPFIMPORT_BATCH	0x20
+
+/*
+ * Binaries larger than this are streamed by libocpf and require the
+ * message to exist before its properties are built
+ */
+#define	OCPFIMPORT_STREAM_SIZE	0x1000
+
+/* A file parsed by a worker thread */
+struct ocpfimport_file {
+	TALLOC_CTX		*mem_ctx;
+	const char		*filename;
+	struct ocpf_context	*ctx;		/* NULL if the file could not be parsed */
+};
+
+/* Files shared between the parser threads and the main thread */
+struct ocpfimport_queue {
+	pthread_mutex_t		mutex;
+	pthread_cond_t		parsed_cond;
+	pthread_cond_t		room_cond;
+	const char		**filenames;
+	uint32_t		count;
+	uint32_t		next;		/* next file to parse */
+	struct ocpfimport_file	*parsed;	/* ring of parsed files */
+	uint32_t		size;
+	uint32_t		head;
+	uint32_t		used;
+	uint32_t		running;	/* parser threads still running */
+};
+
+/* Steps of a batched import */
+enum ocpfimport_step {
+	OCPFIMPORT_CREATE,
+	OCPFIMPORT_SETPROPS,
+	OCPFIMPORT_SAVE,
+	OCPFIMPORT_RELEASE,
+	OCPFIMPORT_DONE
+};
+
+/* A message being imported */
+struct ocpfimport_message {
+	struct ocpfimport_file	file;
+	mapi_object_t		*obj_folder;
+	mapi_object_t		obj_message;
+	struct SPropValue	*lpProps;
+	uint32_t		cValues;
+	enum ocpfimport_step	step;		/* next step to queue */
+	enum MAPISTATUS		status[OCPFIMPORT_DONE];
+};
+
+/* Folders already opened, by OCPF folder value */
+struct ocpfimport_folder {
+	uint64_t			folder;
+	mapi_object_t			obj_folder;
+	struct ocpfimport_folder	*next;
+};
+
+struct ocpfimport {
+	TALLOC_CTX			*mem_ctx;
+	struct mapi_session		*session;
+	mapi_object_t			obj_store;
+	struct ocpfimport_folder	*folders;
+	struct mapi_batch		*batch;
+	uint32_t			queued;		/* calls in the batch */
+	struct ocpfimport_message	**pending;	/* messages in the batch */
+	uint32_t			pending_count;
+	uint32_t			batch_size;
+	uint32_t			imported;
+	uint32_t			failed;
+};
+
+/* Files collected while walking the directories */
+static TALLOC_CTX	*walk_ctx;
+static const char	**walk_files;
+static uint32_t		walk_count;
+
+static int collect_file(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	size_t	len;
+
+	if (type != FTW_F) return 0;
+
+	/* Files given on the command line are always imported */
+	len = strlen(path);
+	if (ftw->level && (len < 5 || strcmp(path + len - 5, ".ocpf"))) return 0;
+
+	walk_files = talloc_realloc(walk_ctx, walk_files, const char *, walk_count + 1);
+	walk_files[walk_count++] = talloc_strdup(walk_files, path);
+
+	return 0;
+}
+
+static void *ocpfimport_parser(void *private_data)
+{
+	struct ocpfimport_queue	*queue = (struct ocpfimport_queue *) private_data;
+	struct ocpfimport_file	file;
+	uint32_t		idx;
+
+	while (1) {
+		pthread_mutex_lock(&queue->mutex);
+		if (queue->next == queue->count) {
+			queue->running--;
+			pthread_cond_signal(&queue->parsed_cond);
+			pthread_mutex_unlock(&queue->mutex);
+			return NULL;
+		}
+		idx = queue->next++;
+		pthread_mutex_unlock(&queue->mutex);
+
+		/* Each file has its own memory hierarchy, released by
+		   the main thread once imported */
+		file.filename = queue->filenames[idx];
+		file.mem_ctx = talloc_named(NULL, 0, "ocpfimport_file");
+		file.ctx = ocpf_new_context_r(file.mem_ctx, file.filename, OCPF_FLAGS_READ);
+		if (file.ctx && ocpf_parse_r(file.ctx) != OCPF_SUCCESS) {
+			file.ctx = NULL;
+		}
+
+		pthread_mutex_lock(&queue->mutex);
+		while (queue->used == queue->size) {
+			pthread_cond_wait(&queue->room_cond, &queue->mutex);
+		}
+		queue->parsed[(queue->head + queue->used) % queue->size] = file;
+		queue->used++;
+		pthread_cond_signal(&queue->parsed_cond);
+		pthread_mutex_unlock(&queue->mutex);
+	}
+}
+
+/*
+ * Return the next parsed file, false once all the files were returned
+ */
+static bool ocpfimport_next_file(struct ocpfimport_queue *queue, struct ocpfimport_file *file)
+{
+	bool	ret = false;
+
+	pthread_mutex_lock(&queue->mutex);
+	while (!queue->used && queue->running) {
+		pthread_cond_wait(&queue->parsed_cond, &queue->mutex);
+	}
+	if (queue->used) {
+		*file = queue->parsed[queue->head];
+		queue->head = (queue->head + 1) % queue->size;
+		queue->used--;
+		pthread_cond_signal(&queue->room_cond);
+		ret = true;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	return ret;
+}
+
+static void ocpfimport_report(struct ocpfimport *imp, const char *filename, const char *step,
+			      enum MAPISTATUS retval)
+{
+	if (retval == MAPI_E_SUCCESS) {
+		imp->imported++;
+		return;
+	}
+
+	imp->failed++;
+	fprintf(stderr, "%s: %s failed: %s\n", filename, step, mapi_get_errstr(retval));
+}
+
+static mapi_object_t *ocpfimport_folder(struct ocpfimport *imp, struct ocpf_context *ctx)
+{
+	struct ocpfimport_folder	*el;
+	enum MAPISTATUS			retval;
+
+	for (el = imp->folders; el; el = el->next) {
+		if (el->folder == ocpf_get_folder_r(ctx)) {
+			return &el->obj_folder;
+		}
+	}
+
+	el = talloc_zero(imp->mem_ctx, struct ocpfimport_folder);
+	el->folder = ocpf_get_folder_r(ctx);
+	retval = ocpf_OpenFolder_r(ctx, &imp->obj_store, &el->obj_folder);
+	if (retval != MAPI_E_SUCCESS) {
+		talloc_free(el);
+		return NULL;
+	}
+	el->next = imp->folders;
+	imp->folders = el;
+
+	return &el->obj_folder;
+}
+
+/*
+ * Map the canonical named properties SetProps would map, the batched
+ * version does not do any call on its own
+ */
+static enum MAPISTATUS ocpfimport_map_names(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder,
+					    struct SPropValue *lpProps, uint32_t cValues)
+{
+	enum MAPISTATUS		retval = MAPI_E_SUCCESS;
+	struct mapi_nameid	*nameid;
+	struct SPropTagArray	*SPropTagArray;
+
+	nameid = mapi_nameid_new(mem_ctx);
+	if (mapi_nameid_lookup_SPropValue(nameid, lpProps, cValues) == MAPI_E_SUCCESS) {
+		SPropTagArray = talloc_zero(mem_ctx, struct SPropTagArray);
+		retval = GetIDsFromNames(obj_folder, nameid->count, nameid->nameid, 0, &SPropTagArray);
+		if (retval == MAPI_E_SUCCESS) {
+			mapi_nameid_map_SPropValue(nameid, lpProps, cValues, SPropTagArray);
+		}
+		MAPIFreeBuffer(SPropTagArray);
+	}
+	MAPIFreeBuffer(nameid);
+
+	return retval;
+}
+
+/*
+ * Import a message in its own round-trips, as openchangeclient does
+ */
+static enum MAPISTATUS ocpfimport_message_sync(struct ocpfimport_file *file, mapi_object_t *obj_folder,
+					       const char **step)
+{
+	enum MAPISTATUS		retval;
+	mapi_object_t		obj_message;
+	struct SPropValue	*lpProps;
+	uint32_t		cValues = 0;
+
+	mapi_object_init(&obj_message);
+
+	*step = "CreateMessage";
+	retval = CreateMessage(obj_folder, &obj_message);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	*step = "ocpf_set_Recipients";
+	retval = ocpf_set_Recipients_r(file->mem_ctx, file->ctx, &obj_message);
+	if (retval != MAPI_E_SUCCESS && GetLastError() != MAPI_E_NOT_FOUND) goto end;
+
+	*step = "ocpf_set_SPropValue";
+	retval = ocpf_set_SPropValue_r(file->mem_ctx, file->ctx, obj_folder, &obj_message);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	*step = "SetProps";
+	lpProps = ocpf_get_SPropValue_r(file->ctx, &cValues);
+	retval = SetProps(&obj_message, 0, lpProps, cValues);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	*step = "SaveChangesMessage";
+	retval = SaveChangesMessage(obj_folder, &obj_message, KeepOpenReadOnly);
+
+end:
+	mapi_object_release(&obj_message);
+	return retval;
+}
+
+static const char *ocpfimport_step_name(enum ocpfimport_step step)
+{
+	switch (step) {
+	case OCPFIMPORT_CREATE:
+		return "CreateMessage";
+	case OCPFIMPORT_SETPROPS:
+		return "SetProps";
+	case OCPFIMPORT_SAVE:
+		return "SaveChangesMessage";
+	default:
+		return "Release";
+	}
+}
+
+/*
+ * Send the batch and report the messages fully queued in it, a
+ * message still being queued is kept pending
+ */
+static void ocpfimport_flush(struct ocpfimport *imp)
+{
+	struct ocpfimport_message	*msg;
+	enum MAPISTATUS			retval;
+	enum ocpfimport_step		step;
+	uint32_t			i;
+	uint32_t			left = 0;
+
+	if (!imp->pending_count) return;
+
+	/* Messages whose steps all failed to queue have nothing to send */
+	retval = imp->queued ? mapi_batch_flush(imp->batch) : MAPI_E_SUCCESS;
+	imp->queued = 0;
+
+	for (i = 0; i < imp->pending_count; i++) {
+		msg = imp->pending[i];
+		if (retval != MAPI_E_SUCCESS) {
+			ocpfimport_report(imp, msg->file.filename, "mapi_batch_flush", retval);
+			talloc_free(msg->file.mem_ctx);
+			continue;
+		}
+
+		/* The message whose remaining steps did not fit */
+		if (msg->step != OCPFIMPORT_DONE) {
+			imp->pending[left++] = msg;
+			continue;
+		}
+
+		/* Release failing is not an import failure */
+		for (step = OCPFIMPORT_CREATE; step < OCPFIMPORT_RELEASE; step++) {
+			if (msg->status[step] != MAPI_E_SUCCESS) break;
+		}
+		ocpfimport_report(imp, msg->file.filename, ocpfimport_step_name(step),
+				  (step < OCPFIMPORT_RELEASE) ? msg->status[step] : MAPI_E_SUCCESS);
+		talloc_free(msg->file.mem_ctx);
+	}
+	imp->pending_count = left;
+}
+
+static enum MAPISTATUS ocpfimport_queue_step(struct ocpfimport *imp, struct ocpfimport_message *msg)
+{
+	enum MAPISTATUS	*status = &msg->status[msg->step];
+
+	switch (msg->step) {
+	case OCPFIMPORT_CREATE:
+		return mapi_batch_CreateMessage(imp->batch, msg->obj_folder, &msg->obj_message, status);
+	case OCPFIMPORT_SETPROPS:
+		return mapi_batch_SetProps(imp->batch, &msg->obj_message, msg->lpProps, msg->cValues, status);
+	case OCPFIMPORT_SAVE:
+		return mapi_batch_SaveChangesMessage(imp->batch, msg->obj_folder, &msg->obj_message,
+						     KeepOpenReadOnly, status);
+	default:
+		return mapi_batch_Release(imp->batch, &msg->obj_message, status);
+	}
+}
+
+/*
+ * Queue the steps of a message, flushing the batch when it is full.
+ * A step too large for an empty batch is done on its own.
+ */
+static void ocpfimport_message_batch(struct ocpfimport *imp, struct ocpfimport_message *msg)
+{
+	enum MAPISTATUS	retval;
+
+	imp->pending[imp->pending_count++] = msg;
+
+	while (msg->step != OCPFIMPORT_DONE) {
+		/* A step flushed earlier failed, the next ones would too */
+		if (msg->step != OCPFIMPORT_CREATE && !imp->queued &&
+		    msg->status[msg->step - 1] != MAPI_E_SUCCESS) {
+			for (; msg->step != OCPFIMPORT_DONE; msg->step++) {
+				msg->status[msg->step] = MAPI_E_CALL_FAILED;
+			}
+			break;
+		}
+
+		msg->status[msg->step] = MAPI_E_CALL_FAILED;
+		retval = ocpfimport_queue_step(imp, msg);
+		if (retval == MAPI_E_NOT_ENOUGH_RESOURCES && imp->queued) {
+			ocpfimport_flush(imp);
+			continue;
+		} else if (retval == MAPI_E_NOT_ENOUGH_RESOURCES && msg->step == OCPFIMPORT_SETPROPS) {
+			msg->status[msg->step] = SetProps(&msg->obj_message, MAPI_PROPS_SKIP_NAMEDID_CHECK,
+							  msg->lpProps, msg->cValues);
+		} else if (retval != MAPI_E_SUCCESS) {
+			msg->status[msg->step] = retval;
+		} else {
+			imp->queued++;
+		}
+		msg->step++;
+	}
+
+	if (imp->pending_count == imp->batch_size) {
+		ocpfimport_flush(imp);
+	}
+}
+
+static void ocpfimport_file(struct ocpfimport *imp, struct ocpfimport_file *file)
+{
+	struct ocpfimport_message	*msg;
+	enum MAPISTATUS			retval;
+	mapi_object_t			*obj_folder;
+	struct SRowSet			*SRowSet;
+	const char			*step;
+	bool				sync = false;
+	uint32_t			i;
+
+	if (!file->ctx) {
+		imp->failed++;
+		fprintf(stderr, "%s: parsing failed\n", file->filename);
+		talloc_free(file->mem_ctx);
+		return;
+	}
+
+	obj_folder = ocpfimport_folder(imp, file->ctx);
+	if (!obj_folder) {
+		ocpfimport_report(imp, file->filename, "ocpf_OpenFolder", GetLastError());
+		talloc_free(file->mem_ctx);
+		return;
+	}
+
+	msg = talloc_zero(file->mem_ctx, struct ocpfimport_message);
+	msg->file = *file;
+	msg->obj_folder = obj_folder;
+	mapi_object_init(&msg->obj_message);
+
+	/* Build the properties without creating the message */
+	retval = ocpf_set_SPropValue_r(file->mem_ctx, file->ctx, obj_folder, NULL);
+	if (retval == MAPI_E_SUCCESS) {
+		msg->lpProps = ocpf_get_SPropValue_r(file->ctx, &msg->cValues);
+		retval = ocpfimport_map_names(file->mem_ctx, obj_folder, msg->lpProps, msg->cValues);
+	}
+	if (retval != MAPI_E_SUCCESS) {
+		ocpfimport_report(imp, file->filename, "ocpf_set_SPropValue", retval);
+		talloc_free(file->mem_ctx);
+		return;
+	}
+
+	/* Recipients and streamed binaries need the message first */
+	if (ocpf_get_recipients_r(file->mem_ctx, file->ctx, &SRowSet) == MAPI_E_SUCCESS) {
+		sync = true;
+	}
+	for (i = 0; i < msg->cValues && !sync; i++) {
+		if ((msg->lpProps[i].ulPropTag & 0xFFFF) == PT_BINARY &&
+		    msg->lpProps[i].value.bin.cb > OCPFIMPORT_STREAM_SIZE) {
+			sync = true;
+		}
+	}
+
+	if (sync) {
+		retval = ocpfimport_message_sync(file, obj_folder, &step);
+		ocpfimport_report(imp, file->filename, step, retval);
+		talloc_free(file->mem_ctx);
+		return;
+	}
+
+	ocpfimport_message_batch(imp, msg);
+}
+
+/*
+ * Initialize MAPI and log on the profile, exit on failure
+ */
+static struct mapi_session *logon(TALLOC_CTX *mem_ctx, struct mapi_context **mapi_ctx,
+				  const char *profdb, const char *profname,
+				  const char *password, const char *debug, bool dumpdata)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_session	*session = NULL;
+	char			*name;
+
+	retval = MAPIInitialize(mapi_ctx, profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", GetLastError());
+		exit (1);
+	}
+
+	/* debug options */
+	SetMAPIDumpData(*mapi_ctx, dumpdata);
+
+	if (debug) {
+		SetMAPIDebugLevel(*mapi_ctx, atoi(debug));
+	}
+
+	/* if no profile is supplied use the default one */
+	if (profname) {
+		name = talloc_strdup(mem_ctx, profname);
+	} else {
+		retval = GetDefaultProfile(*mapi_ctx, &name);
+		if (retval != MAPI_E_SUCCESS) {
+			printf("No profile specified and no default profile found\n");
+			exit (1);
+		}
+	}
+
+	retval = MapiLogonEx(*mapi_ctx, &session, name, password);
+	talloc_free(name);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MapiLogonEx", GetLastError());
+		exit (1);
+	}
+
+	return session;
+}
+
+int main(int argc, const char *argv[])
+{
+	TALLOC_CTX			*mem_ctx;
+	enum MAPISTATUS			retval;
+	struct mapi_context		*mapi_ctx = NULL;
+	struct ocpfimport		imp;
+	struct ocpfimport_queue		queue;
+	struct ocpfimport_file		file;
+	struct ocpfimport_folder	*el;
+	pthread_t			*threads;
+	poptContext			pc;
+	int				opt;
+	int				i;
+	const char			*path;
+	struct timespec			start;
+	struct timespec			end;
+	double				elapsed;
+	const char			*opt_profdb = NULL;
+	const char			*opt_profname = NULL;
+	const char			*opt_password = NULL;
+	const char			*opt_debug = NULL;
+	bool				opt_dumpdata = false;
+	int				opt_threads = 0;
+	int				opt_batch = OCPFIMPORT_BATCH;
+
+	enum {OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD, OPT_DEBUG, OPT_DUMPDATA,
+	      OPT_THREADS, OPT_BATCH};
+
+	struct poptOption long_options[] = {
+		POPT_AUTOHELP
+		{"database", 'f', POPT_ARG_STRING, NULL, OPT_PROFILE_DB, "set the profile database path", "PATH"},
+		{"profile", 'p', POPT_ARG_STRING, NULL, OPT_PROFILE, "set the profile name", "PROFILE"},
+		{"password", 'P', POPT_ARG_STRING, NULL, OPT_PASSWORD, "set the profile password", "PASSWORD"},
+		{"threads", 't', POPT_ARG_INT, &opt_threads, OPT_THREADS, "set the number of parser threads", "COUNT"},
+		{"batch", 'b', POPT_ARG_INT, &opt_batch, OPT_BATCH, "set the number of messages imported per round-trip", "COUNT"},
+		{"debuglevel", 'd', POPT_ARG_STRING, NULL, OPT_DEBUG, "set the debug level", "LEVEL"},
+		{"dump-data", 0, POPT_ARG_NONE, NULL, OPT_DUMPDATA, "dump the hex data", NULL},
+		POPT_OPENCHANGE_VERSION
+		{ NULL, 0, POPT_ARG_NONE, NULL, 0, NULL, NULL }
+	};
+
+	mem_ctx = talloc_named(NULL, 0, "ocpfimport");
+
+	pc = poptGetContext("ocpfimport", argc, argv, long_options, 0);
+	poptSetOtherOptionHelp(pc, "[OPTIONS...] FILE|DIRECTORY...");
+
+	while ((opt = poptGetNextOpt(pc)) != -1) {
+		switch (opt) {
+		case OPT_PROFILE_DB:
+			opt_profdb = poptGetOptArg(pc);
+			break;
+		case OPT_PROFILE:
+			opt_profname = poptGetOptArg(pc);
+			break;
+		case OPT_PASSWORD:
+			opt_password = poptGetOptArg(pc);
+			break;
+		case OPT_DEBUG:
+			opt_debug = poptGetOptArg(pc);
+			break;
+		case OPT_DUMPDATA:
+			opt_dumpdata = true;
+			break;
+		}
+	}
+
+	/**
+	 * Sanity checks
+	 */
+
+	if (!opt_profdb) {
+		opt_profdb = talloc_asprintf(mem_ctx, DEFAULT_PROFDB, getenv("HOME"));
+	}
+
+	if (opt_threads <= 0) {
+		opt_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (opt_threads <= 0) opt_threads = 1;
+	}
+
+	if (opt_batch <= 0) {
+		opt_batch = 1;
+	}
+
+	/**
+	 * Collect the files
+	 */
+
+	walk_ctx = mem_ctx;
+	while ((path = poptGetArg(pc)) != NULL) {
+		if (nftw(path, collect_file, 16, FTW_PHYS) == -1) {
+			fprintf(stderr, "%s: %s\n", path, strerror(errno));
+			exit (1);
+		}
+	}
+	poptFreeContext(pc);
+
+	if (!walk_count) {
+		fprintf(stderr, "No OCPF file to import\n");
+		exit (1);
+	}
+
+	/**
+	 * Log on and open the store
+	 */
+
+	memset(&imp, 0, sizeof (imp));
+	imp.mem_ctx = mem_ctx;
+	imp.batch_size = opt_batch;
+	imp.pending = talloc_array(mem_ctx, struct ocpfimport_message *, opt_batch);
+	imp.session = logon(mem_ctx, &mapi_ctx, opt_profdb, opt_profname, opt_password,
+			    opt_debug, opt_dumpdata);
+
+	mapi_object_init(&imp.obj_store);
+	retval = OpenMsgStore(imp.session, &imp.obj_store);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("OpenMsgStore", GetLastError());
+		exit (1);
+	}
+
+	retval = mapi_batch_begin(mem_ctx, imp.session, &imp.batch);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("mapi_batch_begin", GetLastError());
+		exit (1);
+	}
+
+	/**
+	 * Start the parsers and import what they return
+	 */
+
+	memset(&queue, 0, sizeof (queue));
+	pthread_mutex_init(&queue.mutex, NULL);
+	pthread_cond_init(&queue.parsed_cond, NULL);
+	pthread_cond_init(&queue.room_cond, NULL);
+	queue.filenames = walk_files;
+	queue.count = walk_count;
+	queue.size = opt_batch * 2;
+	queue.parsed = talloc_array(mem_ctx, struct ocpfimport_file, queue.size);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	threads = talloc_array(mem_ctx, pthread_t, opt_threads);
+	for (i = 0; i < opt_threads; i++) {
+		if (pthread_create(&threads[i], NULL, ocpfimport_parser, &queue)) break;
+		queue.running++;
+	}
+	if (!queue.running) {
+		fprintf(stderr, "Unable to start the parser threads\n");
+		exit (1);
+	}
+	opt_threads = queue.running;
+
+	while (ocpfimport_next_file(&queue, &file)) {
+		ocpfimport_file(&imp, &file);
+	}
+	ocpfimport_flush(&imp);
+
+	for (i = 0; i < opt_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%u message(s) imported, %u failed in %.2f seconds\n", imp.imported, imp.failed, elapsed);
+
+	for (el = imp.folders; el; el = el->next) {
+		mapi_object_release(&el->obj_folder);
+	}
+	mapi_object_release(&imp.obj_store);
+	MAPIUninitialize(mapi_ctx);
+
+	pthread_cond_destroy(&queue.room_cond);
+	pthread_cond_destroy(&queue.parsed_cond);
+	pthread_mutex_destroy(&queue.mutex);
+	talloc_free(mem_ctx);
+
+	return imp.failed ? 1 : 0;
+}
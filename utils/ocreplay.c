@@ -0,0 +1,695 @@
+/*
+   Replay captured EcDoRpcExt2 traffic against a server
+
+   OpenChange Project
+
+   Copyright (C) OpenChange Project 2015
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "libmapi/libmapi.h"
+#include "libmapi/libmapi_private.h"
+#include "gen_ndr/ndr_exchange.h"
+#include "utils/openchange-tools.h"
+
+#include <popt.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/*
+  Each directory given on the command line holds the packets of one
+  client session, as extracted by rpcextract: files named
+  <packet>_in_Mapi_EcDoRpcExt2 and <packet>_out_Mapi_EcDoRpcExt2.
+  rpcextract sets the modification time of these files to the capture
+  time of the packet, which is used to replay the original timing.
+
+  Every replay session logs on with the given profile and sends the
+  captured MAPI requests in order:
+
+  - the EcDoRpcExt2 context handle is the one of the replay session,
+  - the EssDN of private mailbox logons is replaced with the mailbox of
+    the profile,
+  - the server object handles of the requests are mapped to the ones
+    the server returned during the replay, using the captured response
+    to match them.
+
+  Folder and message identifiers are sent unmodified: streams must be
+  replayed against the mailbox they were captured on, or a copy of it.
+
+  Sessions run in separate processes. The latency of each call is
+  accounted to every ROP the call carries and the distribution of
+  these latencies is reported per ROP.
+ */
+
+#define	OCREPLAY_BUCKETS	32
+#define	OCREPLAY_ROPS		256
+#define	OCREPLAY_CALLS		OCREPLAY_ROPS
+
+struct ocreplay_stats {
+	uint64_t	count;
+	uint64_t	errors;
+	uint64_t	total_usec;
+	uint64_t	max_usec;
+	uint64_t	buckets[OCREPLAY_BUCKETS];
+};
+
+struct ocreplay_call {
+	uint32_t	packet;
+	char		*request;
+	char		*response;
+	struct timespec	captured;
+};
+
+struct ocreplay_stream {
+	const char		*path;
+	struct ocreplay_call	*calls;
+	uint32_t		count;
+};
+
+struct ocreplay_handle_map {
+	uint32_t	captured;
+	uint32_t	live;
+};
+
+struct ocreplay_session {
+	struct mapi_session		*session;
+	struct ocreplay_handle_map	*handles;
+	uint32_t			handles_count;
+	struct ocreplay_stats		*stats;
+};
+
+static bool	verbose = false;
+
+
+static uint64_t ocreplay_usec(const struct timespec *start, const struct timespec *end)
+{
+	return (uint64_t)(end->tv_sec - start->tv_sec) * 1000000 +
+		(end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+
+static void ocreplay_stats_add(struct ocreplay_stats *stats, uint64_t usec, bool error)
+{
+	uint32_t	bucket;
+
+	for (bucket = 0; bucket < OCREPLAY_BUCKETS - 1 && (usec >> bucket); bucket++);
+
+	stats->count++;
+	if (error) {
+		stats->errors++;
+	}
+	stats->total_usec += usec;
+	if (usec > stats->max_usec) {
+		stats->max_usec = usec;
+	}
+	stats->buckets[bucket]++;
+}
+
+
+static void ocreplay_stats_merge(struct ocreplay_stats *stats, const struct ocreplay_stats *other)
+{
+	uint32_t	bucket;
+
+	stats->count += other->count;
+	stats->errors += other->errors;
+	stats->total_usec += other->total_usec;
+	if (other->max_usec > stats->max_usec) {
+		stats->max_usec = other->max_usec;
+	}
+	for (bucket = 0; bucket < OCREPLAY_BUCKETS; bucket++) {
+		stats->buckets[bucket] += other->buckets[bucket];
+	}
+}
+
+
+/**
+   \details Return the upper bound in microseconds of the bucket a
+   percentile of the calls falls in
+ */
+static uint64_t ocreplay_stats_percentile(const struct ocreplay_stats *stats, uint32_t percent)
+{
+	uint64_t	threshold;
+	uint64_t	total = 0;
+	uint32_t	bucket;
+
+	threshold = (stats->count * percent + 99) / 100;
+	for (bucket = 0; bucket < OCREPLAY_BUCKETS; bucket++) {
+		total += stats->buckets[bucket];
+		if (total >= threshold) break;
+	}
+	if (bucket >= OCREPLAY_BUCKETS - 1) {
+		return stats->max_usec;
+	}
+
+	return ((uint64_t) 1 << bucket);
+}
+
+
+/**
+   \details Return the name of a ROP, as printed by the NDR layer
+ */
+static const char *ocreplay_rop_name(TALLOC_CTX *mem_ctx, uint8_t opnum)
+{
+	struct ndr_print	*ndr;
+	const char		*name;
+	char			*start, *end;
+
+	ndr = talloc_zero(mem_ctx, struct ndr_print);
+	if (!ndr) return "unknown";
+	ndr->private_data = talloc_strdup(ndr, "");
+	ndr->print = ndr_print_string_helper;
+	ndr->depth = 1;
+	ndr_print_MAPI_OPNUM(ndr, "", opnum);
+
+	/* The enum is printed as "<name>: op_MAPI_<rop> (<value>)" */
+	start = strstr((char *)ndr->private_data, "op_MAPI_");
+	if (!start) {
+		talloc_free(ndr);
+		return talloc_asprintf(mem_ctx, "0x%02x", opnum);
+	}
+	start += strlen("op_MAPI_");
+	end = strchr(start, ' ');
+	name = end ? talloc_strndup(mem_ctx, start, end - start) : talloc_strdup(mem_ctx, start);
+	talloc_free(ndr);
+
+	return name;
+}
+
+
+static int ocreplay_call_cmp(const struct ocreplay_call *a, const struct ocreplay_call *b)
+{
+	return (a->packet > b->packet) - (a->packet < b->packet);
+}
+
+
+/**
+   \details Load the list of calls extracted in a directory. Each
+   request is paired with the first response that follows it.
+ */
+static struct ocreplay_stream *ocreplay_stream_load(TALLOC_CTX *mem_ctx, const char *path)
+{
+	struct ocreplay_stream	*stream;
+	struct ocreplay_call	*responses = NULL;
+	struct ocreplay_call	*call;
+	uint32_t		responses_count = 0;
+	uint32_t		i, j;
+	struct dirent		*entry;
+	struct stat		st;
+	DIR			*dir;
+	unsigned int		packet;
+	char			direction[4];
+	char			*filename;
+	int			len;
+
+	dir = opendir(path);
+	if (!dir) {
+		perror(path);
+		return NULL;
+	}
+
+	stream = talloc_zero(mem_ctx, struct ocreplay_stream);
+	stream->path = talloc_strdup(stream, path);
+	stream->calls = talloc_array(stream, struct ocreplay_call, 0);
+	responses = talloc_array(stream, struct ocreplay_call, 0);
+
+	while ((entry = readdir(dir)) != NULL) {
+		len = 0;
+		if (sscanf(entry->d_name, "%u_%3[inout]_Mapi_EcDoRpcExt2%n", &packet, direction, &len) != 2 ||
+		    entry->d_name[len] != '\0') {
+			continue;
+		}
+
+		filename = talloc_asprintf(stream, "%s/%s", path, entry->d_name);
+		if (stat(filename, &st) == -1) {
+			perror(filename);
+			continue;
+		}
+
+		if (!strcmp(direction, "in")) {
+			stream->calls = talloc_realloc(stream, stream->calls, struct ocreplay_call, stream->count + 1);
+			call = &stream->calls[stream->count++];
+		} else if (!strcmp(direction, "out")) {
+			responses = talloc_realloc(stream, responses, struct ocreplay_call, responses_count + 1);
+			call = &responses[responses_count++];
+		} else {
+			continue;
+		}
+		memset(call, 0, sizeof (struct ocreplay_call));
+		call->packet = packet;
+		call->request = filename;
+		call->captured = st.st_mtim;
+	}
+	closedir(dir);
+
+	if (!stream->count) {
+		OC_DEBUG(0, "[ERR] No EcDoRpcExt2 request found in %s", path);
+		talloc_free(stream);
+		return NULL;
+	}
+
+	qsort(stream->calls, stream->count, sizeof (struct ocreplay_call), (int (*)(const void *, const void *)) ocreplay_call_cmp);
+	qsort(responses, responses_count, sizeof (struct ocreplay_call), (int (*)(const void *, const void *)) ocreplay_call_cmp);
+
+	for (i = 0, j = 0; i < stream->count; i++) {
+		while (j < responses_count && responses[j].packet < stream->calls[i].packet) j++;
+		if (j < responses_count && (i + 1 == stream->count || responses[j].packet < stream->calls[i + 1].packet)) {
+			stream->calls[i].response = responses[j++].request;
+		}
+	}
+
+	return stream;
+}
+
+
+/**
+   \details Pull the MAPI request, or response, of an EcDoRpcExt2 call
+   extracted in a file
+ */
+static bool ocreplay_pull_call(TALLOC_CTX *mem_ctx, const char *filename, int flags,
+			       struct mapi_request **req, struct mapi_response **repl)
+{
+	const struct ndr_interface_call	*f = &ndr_table_exchange_emsmdb.calls[NDR_ECDORPCEXT2];
+	struct EcDoRpcExt2		*r;
+	struct mapi2k7_request		mapi2k7_request;
+	struct ndr_pull			*ndr_pull;
+	enum ndr_err_code		ndr_err;
+	DATA_BLOB			blob;
+	size_t				size = 0;
+
+	blob.data = (uint8_t *) file_load(filename, &size, 0, mem_ctx);
+	if (!blob.data) {
+		perror(filename);
+		return false;
+	}
+	blob.length = size;
+
+	r = talloc_zero(mem_ctx, struct EcDoRpcExt2);
+	ndr_pull = ndr_pull_init_blob(&blob, mem_ctx);
+	if (!r || !ndr_pull) return false;
+	ndr_pull->flags |= LIBNDR_FLAG_REF_ALLOC;
+	ndr_err = f->ndr_pull(ndr_pull, flags, r);
+	if (ndr_err != NDR_ERR_SUCCESS) {
+		OC_DEBUG(0, "[ERR] %s: unable to pull EcDoRpcExt2, ndr_err = 0x%x", filename, ndr_err);
+		return false;
+	}
+
+	if (flags == NDR_OUT) {
+		blob.data = r->out.rgbOut;
+		blob.length = *r->out.pcbOut;
+		return NT_STATUS_IS_OK(emsmdb_pull_ext2_response(mem_ctx, &blob, repl));
+	}
+
+	blob.data = r->in.rgbIn;
+	blob.length = r->in.cbIn;
+	ndr_pull = ndr_pull_init_blob(&blob, mem_ctx);
+	if (!ndr_pull) return false;
+	ndr_set_flags(&ndr_pull->flags, LIBNDR_FLAG_NOALIGN|LIBNDR_FLAG_REF_ALLOC);
+	ndr_err = ndr_pull_mapi2k7_request(ndr_pull, NDR_SCALARS|NDR_BUFFERS, &mapi2k7_request);
+	if (ndr_err != NDR_ERR_SUCCESS) {
+		OC_DEBUG(0, "[ERR] %s: unable to pull the MAPI request, ndr_err = 0x%x", filename, ndr_err);
+		return false;
+	}
+	*req = mapi2k7_request.mapi_request;
+
+	return true;
+}
+
+
+/**
+   \details Rewrite a captured request for the replay session
+ */
+static void ocreplay_rewrite_request(struct ocreplay_session *rs, struct mapi_request *req)
+{
+	struct Logon_req	*logon;
+	const char		*mailbox = rs->session->profile->mailbox;
+	uint32_t		count, i, j;
+	int			delta;
+
+	for (i = 0; req->mapi_req && req->mapi_req[i].opnum; i++) {
+		if (req->mapi_req[i].opnum != op_MAPI_Logon) continue;
+
+		logon = &req->mapi_req[i].u.mapi_Logon;
+		if (!(logon->LogonFlags & LogonPrivate) || !logon->EssDN || !mailbox) continue;
+
+		delta = (int) strlen(mailbox) - (int) strlen(logon->EssDN);
+		logon->EssDN = mailbox;
+		req->length += delta;
+		req->mapi_len += delta;
+	}
+
+	count = (req->mapi_len - req->length) / sizeof (uint32_t);
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < rs->handles_count; j++) {
+			if (rs->handles[j].captured == req->handles[i]) {
+				req->handles[i] = rs->handles[j].live;
+				break;
+			}
+		}
+	}
+}
+
+
+/**
+   \details Remember the server object handles returned during the
+   replay, indexed by the ones of the captured response
+ */
+static void ocreplay_map_handles(struct ocreplay_session *rs, struct mapi_response *captured,
+				 struct mapi_response *live)
+{
+	uint32_t	count, i, j;
+
+	count = (captured->mapi_len - captured->length) / sizeof (uint32_t);
+	if ((live->mapi_len - live->length) / sizeof (uint32_t) < count) {
+		count = (live->mapi_len - live->length) / sizeof (uint32_t);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (captured->handles[i] == 0xFFFFFFFF || captured->handles[i] == live->handles[i]) continue;
+
+		for (j = 0; j < rs->handles_count; j++) {
+			if (rs->handles[j].captured == captured->handles[i]) break;
+		}
+		if (j == rs->handles_count) {
+			rs->handles = talloc_realloc(rs->session, rs->handles, struct ocreplay_handle_map, j + 1);
+			rs->handles_count++;
+		}
+		rs->handles[j].captured = captured->handles[i];
+		rs->handles[j].live = live->handles[i];
+	}
+}
+
+
+/**
+   \details Replay the calls of a stream on a session
+ */
+static void ocreplay_stream_run(struct ocreplay_session *rs, struct ocreplay_stream *stream, bool realtime)
+{
+	TALLOC_CTX		*mem_ctx;
+	struct ocreplay_call	*call;
+	struct mapi_request	*req;
+	struct mapi_response	*captured, *live;
+	struct timespec		start, end, origin;
+	uint64_t		usec, offset, elapsed;
+	uint32_t		i, j;
+	bool			seen[OCREPLAY_ROPS];
+	NTSTATUS		status;
+
+	clock_gettime(CLOCK_MONOTONIC, &origin);
+
+	for (i = 0; i < stream->count; i++) {
+		call = &stream->calls[i];
+		mem_ctx = talloc_named(NULL, 0, "ocreplay_call");
+		req = NULL;
+		captured = NULL;
+		live = NULL;
+
+		if (!ocreplay_pull_call(mem_ctx, call->request, NDR_IN, &req, NULL) || !req->mapi_req) {
+			talloc_free(mem_ctx);
+			continue;
+		}
+		if (call->response && !ocreplay_pull_call(mem_ctx, call->response, NDR_OUT, NULL, &captured)) {
+			captured = NULL;
+		}
+		ocreplay_rewrite_request(rs, req);
+
+		if (realtime) {
+			offset = ocreplay_usec(&stream->calls[0].captured, &call->captured);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			elapsed = ocreplay_usec(&origin, &start);
+			if (offset > elapsed) {
+				usleep(offset - elapsed);
+			}
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		status = emsmdb_transaction_wrapper(rs->session, mem_ctx, req, &live);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		usec = ocreplay_usec(&start, &end);
+
+		if (verbose) {
+			OC_DEBUG(0, "[INFO] %s: packet %u replayed in %"PRIu64" us (%s)", stream->path,
+				 call->packet, usec, nt_errstr(status));
+		}
+
+		ocreplay_stats_add(&rs->stats[OCREPLAY_CALLS], usec, !NT_STATUS_IS_OK(status));
+		memset(seen, 0, sizeof (seen));
+		for (j = 0; req->mapi_req[j].opnum; j++) {
+			if (seen[req->mapi_req[j].opnum]) continue;
+			seen[req->mapi_req[j].opnum] = true;
+			ocreplay_stats_add(&rs->stats[req->mapi_req[j].opnum], usec, !NT_STATUS_IS_OK(status));
+		}
+
+		if (NT_STATUS_IS_OK(status) && live) {
+			for (j = 0; live->mapi_repl && live->mapi_repl[j].opnum; j++) {
+				if (live->mapi_repl[j].error_code != MAPI_E_SUCCESS) {
+					rs->stats[live->mapi_repl[j].opnum].errors++;
+				}
+			}
+			if (captured) {
+				ocreplay_map_handles(rs, captured, live);
+			}
+		}
+
+		talloc_free(mem_ctx);
+	}
+}
+
+
+/**
+   \details Run a replay session in the current process and write its
+   counters to fd
+ */
+static int ocreplay_session_run(const char *profdb, const char *profname, const char *password,
+				struct ocreplay_stream **streams, uint32_t streams_count,
+				uint32_t index, uint32_t sessions, bool realtime, int fd)
+{
+	struct mapi_context	*mapi_ctx;
+	struct ocreplay_session	rs;
+	struct ocreplay_stats	stats[OCREPLAY_ROPS + 1];
+	enum MAPISTATUS		retval;
+	uint32_t		i;
+	const uint8_t		*data;
+	size_t			left;
+	ssize_t			ret;
+
+	memset(&rs, 0, sizeof (rs));
+	memset(stats, 0, sizeof (stats));
+	rs.stats = stats;
+
+	retval = MAPIInitialize(&mapi_ctx, profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", retval);
+		return 1;
+	}
+
+	rs.session = octool_init_mapi(mapi_ctx, profname, password, 0);
+	if (!rs.session) {
+		MAPIUninitialize(mapi_ctx);
+		return 1;
+	}
+
+	/* Sessions share the streams, and replay the same one when there
+	   are more sessions than streams */
+	for (i = index % streams_count; i < streams_count; i += sessions) {
+		talloc_free(rs.handles);
+		rs.handles = NULL;
+		rs.handles_count = 0;
+		ocreplay_stream_run(&rs, streams[i], realtime);
+		if (sessions > streams_count) break;
+	}
+
+	MAPIUninitialize(mapi_ctx);
+
+	data = (const uint8_t *) stats;
+	left = sizeof (stats);
+	while (left) {
+		ret = write(fd, data, left);
+		if (ret == -1 && errno == EINTR) continue;
+		if (ret <= 0) return 1;
+		data += ret;
+		left -= ret;
+	}
+
+	return 0;
+}
+
+
+static bool ocreplay_read_stats(int fd, struct ocreplay_stats *stats)
+{
+	uint8_t		*data = (uint8_t *) stats;
+	size_t		left = sizeof (struct ocreplay_stats) * (OCREPLAY_ROPS + 1);
+	ssize_t		ret;
+
+	while (left) {
+		ret = read(fd, data, left);
+		if (ret == -1 && errno == EINTR) continue;
+		if (ret <= 0) return false;
+		data += ret;
+		left -= ret;
+	}
+
+	return true;
+}
+
+
+static void ocreplay_print_stats(const char *name, const struct ocreplay_stats *stats)
+{
+	printf("%-32s %8"PRIu64" %7"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+	       name, stats->count, stats->errors, stats->total_usec / stats->count,
+	       ocreplay_stats_percentile(stats, 50), ocreplay_stats_percentile(stats, 90),
+	       ocreplay_stats_percentile(stats, 99), stats->max_usec);
+}
+
+
+int main(int argc, const char *argv[])
+{
+	TALLOC_CTX			*mem_ctx;
+	struct ocreplay_stream		**streams = NULL;
+	struct ocreplay_stream		*stream;
+	struct ocreplay_stats		total[OCREPLAY_ROPS + 1];
+	struct ocreplay_stats		stats[OCREPLAY_ROPS + 1];
+	struct timespec			start, end;
+	uint32_t			streams_count = 0;
+	uint32_t			sessions = 1;
+	uint32_t			i, rop;
+	uint32_t			failed = 0;
+	bool				realtime = false;
+	const char			*opt_profdb = NULL;
+	const char			*opt_profname = NULL;
+	const char			*opt_password = NULL;
+	const char			*path;
+	pid_t				*pids;
+	int				*fds;
+	int				pipefd[2];
+	int				status;
+	poptContext			pc;
+	int				opt;
+
+	enum { OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_PASSWORD, OPT_SESSIONS, OPT_REALTIME, OPT_VERBOSE };
+	struct poptOption	long_options[] = {
+		POPT_AUTOHELP
+		{ "database", 'f', POPT_ARG_STRING, NULL, OPT_PROFILE_DB, "set the profile database path", "PATH" },
+		{ "profile", 'p', POPT_ARG_STRING, NULL, OPT_PROFILE, "set the profile name", "PROFILE" },
+		{ "password", 'P', POPT_ARG_STRING, NULL, OPT_PASSWORD, "set the profile password", "PASSWORD" },
+		{ "sessions", 'n', POPT_ARG_INT, &sessions, OPT_SESSIONS, "number of parallel sessions", "COUNT" },
+		{ "realtime", 'r', POPT_ARG_NONE, NULL, OPT_REALTIME, "replay with the original timing", NULL },
+		{ "verbose", 'v', POPT_ARG_NONE, NULL, OPT_VERBOSE, "enable verbosity", NULL },
+		POPT_OPENCHANGE_VERSION
+		{ NULL, 0, 0, NULL, 0, NULL, NULL }
+	};
+
+	mem_ctx = talloc_named(NULL, 0, "ocreplay");
+
+	pc = poptGetContext("ocreplay", argc, argv, long_options, 0);
+	poptSetOtherOptionHelp(pc, "DIRECTORY...");
+	while ((opt = poptGetNextOpt(pc)) != -1) {
+		switch (opt) {
+		case OPT_PROFILE_DB:
+			opt_profdb = poptGetOptArg(pc);
+			break;
+		case OPT_PROFILE:
+			opt_profname = poptGetOptArg(pc);
+			break;
+		case OPT_PASSWORD:
+			opt_password = poptGetOptArg(pc);
+			break;
+		case OPT_REALTIME:
+			realtime = true;
+			break;
+		case OPT_VERBOSE:
+			verbose = true;
+			break;
+		}
+	}
+
+	while ((path = poptGetArg(pc)) != NULL) {
+		stream = ocreplay_stream_load(mem_ctx, path);
+		if (!stream) continue;
+		streams = talloc_realloc(mem_ctx, streams, struct ocreplay_stream *, streams_count + 1);
+		streams[streams_count++] = stream;
+	}
+
+	if (!streams_count) {
+		poptPrintUsage(pc, stderr, 0);
+		exit (1);
+	}
+	if (!sessions) {
+		OC_DEBUG(0, "[ERR] At least one session is required");
+		exit (1);
+	}
+
+	if (!opt_profdb) {
+		opt_profdb = talloc_asprintf(mem_ctx, DEFAULT_PROFDB, getenv("HOME"));
+	}
+
+	pids = talloc_array(mem_ctx, pid_t, sessions);
+	fds = talloc_array(mem_ctx, int, sessions);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < sessions; i++) {
+		if (pipe(pipefd) == -1) {
+			perror("pipe");
+			exit (1);
+		}
+		pids[i] = fork();
+		if (pids[i] == -1) {
+			perror("fork");
+			exit (1);
+		}
+		if (pids[i] == 0) {
+			close(pipefd[0]);
+			exit (ocreplay_session_run(opt_profdb, opt_profname, opt_password, streams,
+						   streams_count, i, sessions, realtime, pipefd[1]));
+		}
+		close(pipefd[1]);
+		fds[i] = pipefd[0];
+	}
+
+	memset(total, 0, sizeof (total));
+	for (i = 0; i < sessions; i++) {
+		if (ocreplay_read_stats(fds[i], stats)) {
+			for (rop = 0; rop <= OCREPLAY_ROPS; rop++) {
+				ocreplay_stats_merge(&total[rop], &stats[rop]);
+			}
+		} else {
+			failed++;
+		}
+		close(fds[i]);
+		waitpid(pids[i], &status, 0);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("%"PRIu32" sessions (%"PRIu32" failed), %"PRIu32" streams, %"PRIu64" calls in %"PRIu64" ms\n",
+	       sessions, failed, streams_count, total[OCREPLAY_CALLS].count, ocreplay_usec(&start, &end) / 1000);
+	if (!total[OCREPLAY_CALLS].count) {
+		talloc_free(mem_ctx);
+		exit (1);
+	}
+
+	printf("\nLatency in microseconds, percentiles are bucket upper bounds:\n");
+	printf("%-32s %8s %7s %10s %10s %10s %10s %10s\n", "ROP", "calls", "errors", "avg", "p50", "p90", "p99", "max");
+	for (rop = 0; rop < OCREPLAY_ROPS; rop++) {
+		if (!total[rop].count) continue;
+		ocreplay_print_stats(ocreplay_rop_name(mem_ctx, rop), &total[rop]);
+	}
+	ocreplay_print_stats("EcDoRpcExt2", &total[OCREPLAY_CALLS]);
+
+	poptFreeContext(pc);
+	talloc_free(mem_ctx);
+
+	return (0);
+}
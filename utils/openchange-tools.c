@@ -20,6 +20,7 @@
 */
 
 #include "libmapi/libmapi.h"
+#include "libmapi/fxics.h"
 #include "openchange-tools.h"
 
 static void popt_openchange_version_callback(poptContext con,
@@ -332,3 +333,342 @@ _PUBLIC_ struct mapi_session *octool_init_mapi(struct mapi_context *mapi_ctx,
 	talloc_free(mem_ctx);
 	return session;
 }
+
+
+/* ICS state properties kept in a sync state file, in upload order */
+static const uint32_t octool_sync_state_tags[OCTOOL_SYNC_STATE_COUNT] = {
+	MetaTagIdsetGiven,
+	MetaTagCnsetSeen,
+	MetaTagCnsetSeenFAI,
+	MetaTagCnsetRead
+};
+
+#define	OCTOOL_SYNC_UPLOAD_CHUNK	8192
+
+/* Synchronization stream being parsed */
+struct octool_sync_stream {
+	struct octool_sync	*sync;
+	DATA_BLOB		state[OCTOOL_SYNC_STATE_COUNT];
+	bool			in_header;
+	bool			in_state;
+};
+
+
+/* State files are little-endian */
+static uint32_t octool_sync_pull_uint32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static void octool_sync_push_uint32(uint8_t *buf, uint32_t val)
+{
+	buf[0] = val & 0xFF;
+	buf[1] = (val >> 8) & 0xFF;
+	buf[2] = (val >> 16) & 0xFF;
+	buf[3] = (val >> 24) & 0xFF;
+}
+
+
+/*
+ * Load the ICS state saved by a previous synchronization.
+ *
+ * A missing file gives an empty state, for which the server reports
+ * every item of the folder as changed.
+ */
+_PUBLIC_ struct octool_sync *octool_sync_load(TALLOC_CTX *mem_ctx, const char *filename)
+{
+	struct octool_sync	*sync;
+	FILE			*fp;
+	uint8_t			*data;
+	long			size;
+	long			offset;
+	uint32_t		tag;
+	uint32_t		length;
+	uint32_t		i;
+
+	sync = talloc_zero(mem_ctx, struct octool_sync);
+	if (!sync) return NULL;
+
+	fp = fopen(filename, "r");
+	if (!fp && errno == ENOENT) {
+		return sync;
+	}
+
+	data = NULL;
+	if (fp && fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 &&
+	    fseek(fp, 0, SEEK_SET) == 0) {
+		data = talloc_size(sync, size + 1);
+		if (data && size && fread(data, size, 1, fp) != 1) {
+			talloc_free(data);
+			data = NULL;
+		}
+	}
+	if (fp) {
+		fclose(fp);
+	}
+	if (!data) {
+		fprintf(stderr, "Unable to read sync state %s: %s\n", filename, strerror(errno));
+		talloc_free(sync);
+		return NULL;
+	}
+
+	/* The file is a sequence of (property tag, length, state) records */
+	for (offset = 0; offset < size; offset += length) {
+		if (size - offset < 8) goto corrupted;
+		tag = octool_sync_pull_uint32(data + offset);
+		length = octool_sync_pull_uint32(data + offset + 4);
+		offset += 8;
+		if (length > size - offset) goto corrupted;
+
+		for (i = 0; i < OCTOOL_SYNC_STATE_COUNT; i++) {
+			if (octool_sync_state_tags[i] == tag) break;
+		}
+		if (i == OCTOOL_SYNC_STATE_COUNT) goto corrupted;
+		sync->state[i] = data_blob_talloc(sync, data + offset, length);
+	}
+
+	talloc_free(data);
+	return sync;
+
+corrupted:
+	fprintf(stderr, "Sync state %s is corrupted\n", filename);
+	talloc_free(sync);
+	return NULL;
+}
+
+
+/*
+ * Save the ICS state for the next synchronization. The file is
+ * replaced atomically so that an interrupted run keeps the previous
+ * state.
+ */
+_PUBLIC_ bool octool_sync_save(struct octool_sync *sync, const char *filename)
+{
+	char		*tmpname;
+	uint8_t		header[8];
+	FILE		*fp;
+	bool		ret = true;
+	uint32_t	i;
+
+	tmpname = talloc_asprintf(sync, "%s.tmp", filename);
+	if (!tmpname) return false;
+
+	fp = fopen(tmpname, "w");
+	if (!fp) {
+		fprintf(stderr, "Unable to write sync state %s: %s\n", tmpname, strerror(errno));
+		talloc_free(tmpname);
+		return false;
+	}
+
+	for (i = 0; i < OCTOOL_SYNC_STATE_COUNT && ret; i++) {
+		if (!sync->state[i].length) continue;
+		octool_sync_push_uint32(header, octool_sync_state_tags[i]);
+		octool_sync_push_uint32(header + 4, sync->state[i].length);
+		ret = (fwrite(header, sizeof (header), 1, fp) == 1 &&
+		       fwrite(sync->state[i].data, sync->state[i].length, 1, fp) == 1);
+	}
+	if (fclose(fp) != 0) {
+		ret = false;
+	}
+
+	if (ret && rename(tmpname, filename) == -1) {
+		ret = false;
+	}
+	if (!ret) {
+		fprintf(stderr, "Unable to write sync state %s: %s\n", filename, strerror(errno));
+		unlink(tmpname);
+	}
+
+	talloc_free(tmpname);
+	return ret;
+}
+
+
+static enum MAPISTATUS octool_sync_marker(uint32_t marker, void *priv)
+{
+	struct octool_sync_stream	*stream = (struct octool_sync_stream *) priv;
+
+	switch (marker) {
+	case IncrSyncChg:
+		stream->in_header = true;
+		break;
+	case IncrSyncMessage:
+		stream->in_header = false;
+		break;
+	case IncrSyncStateBegin:
+		stream->in_state = true;
+		break;
+	case IncrSyncStateEnd:
+		stream->in_state = false;
+		break;
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static enum MAPISTATUS octool_sync_property(struct SPropValue prop, void *priv)
+{
+	struct octool_sync_stream	*stream = (struct octool_sync_stream *) priv;
+	struct octool_sync		*sync = stream->sync;
+	struct idset			*idset;
+	DATA_BLOB			blob;
+	uint32_t			i;
+
+	if (stream->in_header && prop.ulPropTag == PidTagMid) {
+		sync->changed = talloc_realloc(sync, sync->changed, mapi_id_t, sync->changed_count + 1);
+		OPENCHANGE_RETVAL_IF(!sync->changed, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+		sync->changed[sync->changed_count++] = prop.value.d;
+		return MAPI_E_SUCCESS;
+	}
+
+	if ((prop.ulPropTag & 0xFFFF) != PT_BINARY) {
+		return MAPI_E_SUCCESS;
+	}
+	blob.data = prop.value.bin.lpb;
+	blob.length = prop.value.bin.cb;
+
+	if (prop.ulPropTag == MetaTagIdsetDeleted) {
+		idset = IDSET_parse(sync, blob, true);
+		OPENCHANGE_RETVAL_IF(!idset, MAPI_E_CORRUPT_DATA, NULL);
+		for (i = 0; i < idset->range_count; i++) {
+			sync->deleted_count += exchange_globcnt(idset->ranges[i].high) -
+				exchange_globcnt(idset->ranges[i].low) + 1;
+		}
+		if (sync->deleted) {
+			idset = IDSET_merge_idsets(sync, sync->deleted, idset);
+		}
+		sync->deleted = idset;
+		return MAPI_E_SUCCESS;
+	}
+
+	if (stream->in_state) {
+		/* MetaTagIdsetGiven is reported by the parser with a
+		   PT_BINARY type */
+		for (i = 0; i < OCTOOL_SYNC_STATE_COUNT; i++) {
+			if ((octool_sync_state_tags[i] & 0xFFFF0000) == (prop.ulPropTag & 0xFFFF0000)) {
+				talloc_free(stream->state[i].data);
+				stream->state[i] = data_blob_talloc(sync, blob.data, blob.length);
+				break;
+			}
+		}
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+static enum MAPISTATUS octool_sync_upload_state(mapi_object_t *obj_sync, struct octool_sync *sync)
+{
+	enum MAPISTATUS	retval;
+	DATA_BLOB	chunk;
+	uint32_t	offset;
+	uint32_t	i;
+
+	for (i = 0; i < OCTOOL_SYNC_STATE_COUNT; i++) {
+		if (!sync->state[i].length) continue;
+
+		retval = ICSSyncUploadStateBegin(obj_sync, (enum StateProperty) octool_sync_state_tags[i],
+						 sync->state[i].length);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		for (offset = 0; offset < sync->state[i].length; offset += chunk.length) {
+			chunk.data = sync->state[i].data + offset;
+			chunk.length = MIN(OCTOOL_SYNC_UPLOAD_CHUNK, sync->state[i].length - offset);
+			retval = ICSSyncUploadStateContinue(obj_sync, chunk);
+			OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+		}
+		retval = ICSSyncUploadStateEnd(obj_sync);
+		OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+	}
+
+	return MAPI_E_SUCCESS;
+}
+
+
+/*
+ * Download the changes made to a folder contents since the state
+ * held by sync.
+ *
+ * The message identifiers of new and modified items are stored in
+ * sync->changed, those of deleted items in sync->deleted. Only the
+ * message headers are transferred, callers fetch the items they need.
+ * The state is updated once the whole stream has been received.
+ */
+_PUBLIC_ enum MAPISTATUS octool_sync_contents(mapi_object_t *obj_folder, struct octool_sync *sync)
+{
+	enum MAPISTATUS			retval;
+	TALLOC_CTX			*mem_ctx;
+	mapi_object_t			obj_sync;
+	struct SPropTagArray		*SPropTagArray;
+	struct fx_parser_context	*parser;
+	struct octool_sync_stream	stream;
+	enum TransferStatus		status;
+	uint16_t			progress;
+	uint16_t			total;
+	DATA_BLOB			restriction;
+	DATA_BLOB			buffer;
+	uint32_t			i;
+
+	mem_ctx = talloc_named(NULL, 0, "octool_sync_contents");
+	memset(&stream, 0, sizeof (stream));
+	stream.sync = sync;
+	sync->changed_count = 0;
+	sync->deleted_count = 0;
+	sync->deleted = NULL;
+
+	/* Only ask for the message identifiers, which the server sends in
+	   the change headers when the Eid flag is set */
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x1, PidTagMid);
+	restriction = data_blob_null;
+
+	mapi_object_init(&obj_sync);
+	retval = ICSSyncConfigure(obj_folder, Contents, FastTransfer_Unicode,
+				  SynchronizationFlag_Unicode | SynchronizationFlag_Normal |
+				  SynchronizationFlag_NoForeignIdentifiers |
+				  SynchronizationFlag_OnlySpecifiedProperties,
+				  Eid | Cn, restriction, SPropTagArray, &obj_sync);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	retval = octool_sync_upload_state(&obj_sync, sync);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	parser = fxparser_init(mem_ctx, &stream);
+	fxparser_set_marker_callback(parser, octool_sync_marker);
+	fxparser_set_property_callback(parser, octool_sync_property);
+
+	do {
+		retval = FXGetBuffer(&obj_sync, 0, &status, &progress, &total, &buffer);
+		if (retval != MAPI_E_SUCCESS) goto end;
+		if (status == TransferStatus_Error) {
+			retval = MAPI_E_CALL_FAILED;
+			goto end;
+		}
+		retval = fxparser_parse(parser, &buffer);
+		if (retval != MAPI_E_SUCCESS) goto end;
+	} while (status != TransferStatus_Done);
+
+	for (i = 0; i < OCTOOL_SYNC_STATE_COUNT; i++) {
+		talloc_free(sync->state[i].data);
+		sync->state[i] = stream.state[i];
+		stream.state[i] = data_blob_null;
+	}
+
+end:
+	for (i = 0; i < OCTOOL_SYNC_STATE_COUNT; i++) {
+		talloc_free(stream.state[i].data);
+	}
+	mapi_object_release(&obj_sync);
+	talloc_free(mem_ctx);
+
+	return retval;
+}
+
+
+/*
+ * Tell whether a message was reported deleted by the last
+ * synchronization.
+ */
+_PUBLIC_ bool octool_sync_deleted(struct octool_sync *sync, mapi_id_t mid)
+{
+	return IDSET_includes_eid(sync->deleted, mid);
+}
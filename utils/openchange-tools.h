@@ -31,6 +31,17 @@
 #define	DEFAULT_VCF	"%s/.openchange/vcf"
 #define	DEFAULT_DIR	"%s/.openchange"
 
+#define	OCTOOL_SYNC_STATE_COUNT	4
+
+/* Incremental synchronization of a folder contents */
+struct octool_sync {
+	DATA_BLOB		state[OCTOOL_SYNC_STATE_COUNT];
+	mapi_id_t		*changed;
+	uint32_t		changed_count;
+	struct idset		*deleted;
+	uint32_t		deleted_count;
+};
+
 #ifndef __BEGIN_DECLS
 #ifdef __cplusplus
 #define __BEGIN_DECLS		extern "C" {
@@ -59,6 +70,10 @@ _PUBLIC_ enum MAPISTATUS octool_get_stream(TALLOC_CTX *mem_ctx,
 					 mapi_object_t *obj_stream, 
 					 DATA_BLOB *body);
 _PUBLIC_ struct mapi_session *octool_init_mapi(struct mapi_context *, const char *, const char *, uint32_t);
+_PUBLIC_ struct octool_sync *octool_sync_load(TALLOC_CTX *, const char *);
+_PUBLIC_ bool octool_sync_save(struct octool_sync *, const char *);
+_PUBLIC_ enum MAPISTATUS octool_sync_contents(mapi_object_t *, struct octool_sync *);
+_PUBLIC_ bool octool_sync_deleted(struct octool_sync *, mapi_id_t);
 __END_DECLS
 
 #endif /*!__OPENCHANGETOOLS_H__ */
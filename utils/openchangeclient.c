@@ -35,6 +35,10 @@
 #include <fcntl.h>
 #include <time.h>
 #include <ctype.h>
+#include <sys/wait.h>
+
+/* Messages opened per round-trip by --batch at most */
+#define	OCLIENT_BATCH_MAX	100
 
 /**
  * init sendmail struct
@@ -95,6 +99,14 @@ static void init_oclient(struct oclient *oclient)
 	/* ocpf related parameters */
 	oclient->ocpf_files = NULL;
 	oclient->ocpf_dump = NULL;
+	oclient->ocpf_count = 0;
+	oclient->ocpf_vars = NULL;
+
+	/* bulk fetch related parameters */
+	oclient->batch = 0;
+	oclient->ics = false;
+	oclient->sessions = 1;
+	memset(&oclient->stats, 0, sizeof (oclient->stats));
 }
 
 static enum MAPISTATUS openchangeclient_getdir(TALLOC_CTX *mem_ctx,
@@ -1567,29 +1579,6 @@ static bool openchangeclient_sendnote(TALLOC_CTX *mem_ctx, mapi_object_t *obj_st
 }
 
 
-static const char *get_container_class(TALLOC_CTX *mem_ctx, mapi_object_t *parent, mapi_id_t folder_id)
-{
-	enum MAPISTATUS		retval;
-	mapi_object_t		obj_folder;
-	struct SPropTagArray	*SPropTagArray;
-	struct SPropValue	*lpProps;
-	uint32_t		count;
-
-	mapi_object_init(&obj_folder);
-	retval = OpenFolder(parent, folder_id, &obj_folder);
-	if (retval != MAPI_E_SUCCESS) return false;
-
-	SPropTagArray = set_SPropTagArray(mem_ctx, 0x1, PR_CONTAINER_CLASS);
-	retval = GetProps(&obj_folder, MAPI_UNICODE, SPropTagArray, &lpProps, &count);
-	MAPIFreeBuffer(SPropTagArray);
-	mapi_object_release(&obj_folder);
-	if ((lpProps[0].ulPropTag != PR_CONTAINER_CLASS) || (retval != MAPI_E_SUCCESS)) {
-		errno = 0;
-		return IPF_NOTE;
-	}
-	return lpProps[0].value.lpszA;
-}
-
 static bool get_child_folders(TALLOC_CTX *mem_ctx, mapi_object_t *parent, mapi_id_t folder_id, int count)
 {
 	enum MAPISTATUS		retval;
@@ -1598,8 +1587,10 @@ static bool get_child_folders(TALLOC_CTX *mem_ctx, mapi_object_t *parent, mapi_i
 	mapi_object_t		obj_htable;
 	struct SPropTagArray	*SPropTagArray;
 	struct SRowSet		rowset;
+	struct SRowSet_index	*columns;
 	const char	       	*name;
 	const char		*comment;
+	const char		*container_class;
 	const uint32_t		*total;
 	const uint32_t		*unread;
 	const uint32_t		*child;
@@ -1615,32 +1606,35 @@ static bool get_child_folders(TALLOC_CTX *mem_ctx, mapi_object_t *parent, mapi_i
 	retval = GetHierarchyTable(&obj_folder, &obj_htable, 0, NULL);
 	if (retval != MAPI_E_SUCCESS) return false;
 
-	SPropTagArray = set_SPropTagArray(mem_ctx, 0x6,
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x7,
 					  PR_DISPLAY_NAME_UNICODE,
 					  PR_FID,
 					  PR_COMMENT_UNICODE,
 					  PR_CONTENT_UNREAD,
 					  PR_CONTENT_COUNT,
-					  PR_FOLDER_CHILD_COUNT);
+					  PR_FOLDER_CHILD_COUNT,
+					  PR_CONTAINER_CLASS_UNICODE);
 	retval = SetColumns(&obj_htable, SPropTagArray);
+	columns = SRowSet_index_init(mem_ctx, &rowset, SPropTagArray);
 	MAPIFreeBuffer(SPropTagArray);
-	if (retval != MAPI_E_SUCCESS) return false;
+	if (retval != MAPI_E_SUCCESS || !columns) return false;
 	
 	while (((retval = QueryRows(&obj_htable, 0x32, TBL_ADVANCE, TBL_FORWARD_READ, &rowset)) != MAPI_E_NOT_FOUND) && rowset.cRows) {
 		for (index = 0; index < rowset.cRows; index++) {
-			fid = (const uint64_t *)find_SPropValue_data(&rowset.aRow[index], PR_FID);
-			name = (const char *)find_SPropValue_data(&rowset.aRow[index], PR_DISPLAY_NAME_UNICODE);
-			comment = (const char *)find_SPropValue_data(&rowset.aRow[index], PR_COMMENT_UNICODE);
-			total = (const uint32_t *)find_SPropValue_data(&rowset.aRow[index], PR_CONTENT_COUNT);
-			unread = (const uint32_t *)find_SPropValue_data(&rowset.aRow[index], PR_CONTENT_UNREAD);
-			child = (const uint32_t *)find_SPropValue_data(&rowset.aRow[index], PR_FOLDER_CHILD_COUNT);
+			fid = (const uint64_t *)SRowSet_index_find_data(columns, index, PR_FID);
+			name = (const char *)SRowSet_index_find_data(columns, index, PR_DISPLAY_NAME_UNICODE);
+			comment = (const char *)SRowSet_index_find_data(columns, index, PR_COMMENT_UNICODE);
+			total = (const uint32_t *)SRowSet_index_find_data(columns, index, PR_CONTENT_COUNT);
+			unread = (const uint32_t *)SRowSet_index_find_data(columns, index, PR_CONTENT_UNREAD);
+			child = (const uint32_t *)SRowSet_index_find_data(columns, index, PR_FOLDER_CHILD_COUNT);
+			container_class = (const char *)SRowSet_index_find_data(columns, index, PR_CONTAINER_CLASS_UNICODE);
 
 			for (i = 0; i < count; i++) {
 				printf("|   ");
 			}
 			printf("|---+ %-15s : %-20s (Total: %u / Unread: %u - Container class: %s) [FID: 0x%016"PRIx64"]\n", 
 			       name, comment?comment:"", total?*total:0, unread?*unread:0,
-			       get_container_class(mem_ctx, parent, *fid), *fid);
+			       container_class?container_class:IPF_NOTE, *fid);
 			if (child && *child) {
 				ret = get_child_folders(mem_ctx, &obj_folder, *fid, count + 1);
 				if (ret == false) return ret;
@@ -1648,6 +1642,7 @@ static bool get_child_folders(TALLOC_CTX *mem_ctx, mapi_object_t *parent, mapi_i
 			
 		}
 	}
+	talloc_free(columns);
 	mapi_object_release(&obj_htable);
 	mapi_object_release(&obj_folder);
 
@@ -1747,25 +1742,257 @@ static bool openchangeclient_mailbox(TALLOC_CTX *mem_ctx,
 	return get_child_folders(mem_ctx, obj_store, id_mailbox, 0);
 }
 
+static double oclient_now(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Account a round-trip started at started in the fetch statistics
+ */
+static void oclient_stats_request(struct oclient *oclient, double started)
+{
+	double	elapsed = oclient_now() - started;
+
+	oclient->stats.requests++;
+	oclient->stats.latency += elapsed;
+	if (elapsed > oclient->stats.latency_max) {
+		oclient->stats.latency_max = elapsed;
+	}
+}
+
+static void oclient_stats_print(const struct oclient_stats *stats, double elapsed)
+{
+	fprintf(stderr, "[+] %u messages in %.2f seconds (%.1f messages/s), %u requests, "
+		"latency %.1f ms average / %.1f ms max\n",
+		stats->messages, elapsed, elapsed > 0 ? stats->messages / elapsed : 0,
+		stats->requests, stats->requests ? stats->latency * 1000 / stats->requests : 0,
+		stats->latency_max * 1000);
+}
+
+static void openchangeclient_dumpitem(TALLOC_CTX *mem_ctx, mapi_object_t *obj_message, uint32_t olFolder,
+				      mapi_id_t fid, mapi_id_t mid, struct oclient *oclient)
+{
+	enum MAPISTATUS			retval;
+	struct mapi_SPropValue_array	properties_array;
+	double				started;
+	char				*id;
+
+	oclient->stats.messages++;
+
+	/* The summary only needs what OpenMessage returned */
+	if (oclient->summary) {
+		mapidump_message_summary(obj_message);
+		return;
+	}
+
+	started = oclient_now();
+	retval = GetPropsAll(obj_message, MAPI_UNICODE, &properties_array);
+	oclient_stats_request(oclient, started);
+	if (retval != MAPI_E_SUCCESS) return;
+
+	id = talloc_asprintf(mem_ctx, ": %"PRIX64"/%"PRIX64, fid, mid);
+	mapi_SPropValue_array_named(obj_message, &properties_array);
+	switch (olFolder) {
+	case olFolderInbox:
+		mapidump_message(&properties_array, id, NULL);
+		break;
+	case olFolderCalendar:
+		mapidump_appointment(&properties_array, id);
+		break;
+	case olFolderContacts:
+		mapidump_contact(&properties_array, id);
+		break;
+	case olFolderTasks:
+		mapidump_task(&properties_array, id);
+		break;
+	case olFolderNotes:
+		mapidump_note(&properties_array, id);
+		break;
+	}
+	talloc_free(id);
+}
+
+/*
+ * List the messages of a folder from its contents table, or with an
+ * ICS contents synchronization when --ics is given
+ */
+static enum MAPISTATUS openchangeclient_listitems(TALLOC_CTX *mem_ctx, mapi_object_t *obj_folder,
+						  struct oclient *oclient, mapi_id_t **midsp, uint32_t *countp)
+{
+	enum MAPISTATUS			retval;
+	mapi_object_t			obj_table;
+	struct octool_sync		*sync;
+	struct SPropTagArray		*SPropTagArray;
+	struct SRowSet			SRowSet;
+	mapi_id_t			*mids;
+	uint32_t			count;
+	uint32_t			done;
+	uint32_t			i;
+	double				started;
+
+	if (oclient->ics) {
+		/* An empty state gets every message reported */
+		sync = talloc_zero(mem_ctx, struct octool_sync);
+		OPENCHANGE_RETVAL_IF(!sync, MAPI_E_NOT_ENOUGH_MEMORY, NULL);
+
+		started = oclient_now();
+		retval = octool_sync_contents(obj_folder, sync);
+		oclient_stats_request(oclient, started);
+		OPENCHANGE_RETVAL_IF(retval, retval, sync);
+
+		*midsp = sync->changed;
+		*countp = sync->changed_count;
+		return MAPI_E_SUCCESS;
+	}
+
+	mapi_object_init(&obj_table);
+	started = oclient_now();
+	retval = GetContentsTable(obj_folder, &obj_table, 0, &count);
+	oclient_stats_request(oclient, started);
+	OPENCHANGE_RETVAL_IF(retval, retval, NULL);
+
+	SPropTagArray = set_SPropTagArray(mem_ctx, 0x1, PR_MID);
+	started = oclient_now();
+	retval = SetColumns(&obj_table, SPropTagArray);
+	oclient_stats_request(oclient, started);
+	MAPIFreeBuffer(SPropTagArray);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_object_release(&obj_table);
+		return retval;
+	}
+
+	mids = talloc_array(mem_ctx, mapi_id_t, count ? count : 1);
+	done = 0;
+	while (done < count) {
+		started = oclient_now();
+		retval = QueryRows(&obj_table, count - done, TBL_ADVANCE, TBL_FORWARD_READ, &SRowSet);
+		oclient_stats_request(oclient, started);
+		if (retval == MAPI_E_NOT_FOUND || !SRowSet.cRows) break;
+		for (i = 0; i < SRowSet.cRows && done < count; i++) {
+			mids[done++] = SRowSet.aRow[i].lpProps[0].value.d;
+		}
+	}
+	mapi_object_release(&obj_table);
+
+	*midsp = mids;
+	*countp = done;
+
+	return MAPI_E_SUCCESS;
+}
+
+/*
+ * Open and dump messages one at a time, or with --batch open each group
+ * of messages and release the previous one in a single round-trip
+ */
+static bool openchangeclient_fetchmessages(TALLOC_CTX *mem_ctx, mapi_object_t *obj_store,
+					   mapi_object_t *obj_folder, uint32_t olFolder, mapi_id_t fid,
+					   const mapi_id_t *mids, uint32_t count, struct oclient *oclient)
+{
+	enum MAPISTATUS		retval;
+	mapi_object_t		obj_message;
+	mapi_object_t		*obj_messages;
+	enum MAPISTATUS		*status;
+	struct mapi_batch	*batch;
+	uint32_t		size;
+	uint32_t		done;
+	uint32_t		prev;
+	uint32_t		base;
+	uint32_t		n;
+	uint32_t		i;
+	double			started;
+
+	if (!oclient->batch) {
+		for (i = 0; i < count; i++) {
+			mapi_object_init(&obj_message);
+			started = oclient_now();
+			retval = OpenMessage(obj_folder, fid, mids[i], &obj_message, 0);
+			oclient_stats_request(oclient, started);
+			if (retval != MAPI_E_NOT_FOUND) {
+				openchangeclient_dumpitem(mem_ctx, &obj_message, olFolder, fid, mids[i], oclient);
+				started = oclient_now();
+				mapi_object_release(&obj_message);
+				oclient_stats_request(oclient, started);
+			}
+		}
+		return true;
+	}
+
+	retval = mapi_batch_begin(mem_ctx, mapi_object_get_session(obj_store), &batch);
+	if (retval != MAPI_E_SUCCESS) return false;
+
+	/* Two groups: the one being opened and the one being released */
+	size = MIN(oclient->batch, OCLIENT_BATCH_MAX);
+	obj_messages = talloc_array(batch, mapi_object_t, size * 2);
+	status = talloc_array(batch, enum MAPISTATUS, size * 2);
+	if (!obj_messages || !status) {
+		talloc_free(batch);
+		return false;
+	}
+
+	for (done = 0, prev = 0, base = 0; done < count || prev; done += n, base = size - base) {
+		for (i = 0; i < prev; i++) {
+			if (status[size - base + i] == MAPI_E_SUCCESS) {
+				mapi_batch_Release(batch, &obj_messages[size - base + i], NULL);
+			}
+		}
+
+		n = MIN(size, count - done);
+		for (i = 0; i < n; i++) {
+			mapi_object_init(&obj_messages[base + i]);
+			/* Overwritten with the result of the call on flush */
+			status[base + i] = mapi_batch_OpenMessage(batch, obj_store, fid, mids[done + i],
+								  &obj_messages[base + i], 0, &status[base + i]);
+		}
+
+		started = oclient_now();
+		retval = mapi_batch_flush(batch);
+		oclient_stats_request(oclient, started);
+		if (retval != MAPI_E_SUCCESS) {
+			mapi_errstr("mapi_batch_flush", GetLastError());
+			talloc_free(batch);
+			return false;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (status[base + i] == MAPI_E_SUCCESS) {
+				openchangeclient_dumpitem(mem_ctx, &obj_messages[base + i], olFolder,
+							  fid, mids[done + i], oclient);
+			}
+		}
+		prev = n;
+	}
+	talloc_free(batch);
+
+	return true;
+}
+
+/*
+ * Fetch the items of a default folder. With several sessions, worker
+ * fetches its share of the messages.
+ */
 static bool openchangeclient_fetchitems(TALLOC_CTX *mem_ctx, mapi_object_t *obj_store, const char *item,
-					struct oclient *oclient)
+					struct oclient *oclient, unsigned int worker, unsigned int workers)
 {
 	enum MAPISTATUS			retval;
 	mapi_object_t			obj_tis;
 	mapi_object_t			obj_folder;
-	mapi_object_t			obj_table;
-	mapi_object_t			obj_message;
 	mapi_id_t			fid;
+	mapi_id_t			*mids;
 	uint32_t			olFolder = 0;
-	struct SRowSet			SRowSet;
-	struct SPropTagArray		*SPropTagArray;
-	struct mapi_SPropValue_array	properties_array;
 	uint32_t			count;
+	uint32_t			first;
+	uint32_t			last;
 	uint32_t       			i;
-	char				*id;
+	bool				ret;
+	double				started;
 	
 	if (!item) return false;
 
+	started = oclient_now();
 	mapi_object_init(&obj_tis);
 	mapi_object_init(&obj_folder);
 
@@ -1801,81 +2028,185 @@ static bool openchangeclient_fetchitems(TALLOC_CTX *mem_ctx, mapi_object_t *obj_
 	}
 
 	/* Operations on the  folder */
-	mapi_object_init(&obj_table);
-	retval = GetContentsTable(&obj_folder, &obj_table, 0, &count);
+	retval = openchangeclient_listitems(mem_ctx, &obj_folder, oclient, &mids, &count);
 	if (retval != MAPI_E_SUCCESS) return false;
 
-	printf("MAILBOX (%u messages)\n", count);
-	if (!count) {
-		mapi_object_release(&obj_table);
-		mapi_object_release(&obj_folder);
-		mapi_object_release(&obj_tis);
+	if (!worker) {
+		printf("MAILBOX (%u messages)\n", count);
+	}
 
-		return true;
+	/* Workers take consecutive ranges of messages */
+	first = (uint64_t)count * worker / workers;
+	last = (uint64_t)count * (worker + 1) / workers;
+	ret = openchangeclient_fetchmessages(mem_ctx, obj_store, &obj_folder, olFolder,
+					     mapi_object_get_id(&obj_folder),
+					     mids + first, last - first, oclient);
+
+	mapi_object_release(&obj_folder);
+	mapi_object_release(&obj_tis);
+
+	if (workers == 1) {
+		oclient_stats_print(&oclient->stats, oclient_now() - started);
 	}
 
-	SPropTagArray = set_SPropTagArray(mem_ctx, 0x8,
-					  PR_FID,
-					  PR_MID,
-					  PR_INST_ID,
-					  PR_INSTANCE_NUM,
-					  PR_SUBJECT_UNICODE,
-					  PR_MESSAGE_CLASS_UNICODE,
-					  PR_RULE_MSG_PROVIDER,
-					  PR_RULE_MSG_NAME);
-	retval = SetColumns(&obj_table, SPropTagArray);
-	MAPIFreeBuffer(SPropTagArray);
-	if (retval != MAPI_E_SUCCESS) return false;
+	return ret;
+}
 
-	while ((retval = QueryRows(&obj_table, count, TBL_ADVANCE, TBL_FORWARD_READ, &SRowSet)) != MAPI_E_NOT_FOUND && SRowSet.cRows) {
-		count -= SRowSet.cRows;
-		for (i = 0; i < SRowSet.cRows; i++) {
-			mapi_object_init(&obj_message);
-			retval = OpenMessage(&obj_folder, 
-					     SRowSet.aRow[i].lpProps[0].value.d,
-					     SRowSet.aRow[i].lpProps[1].value.d,
-					     &obj_message, 0);
-			if (retval != MAPI_E_NOT_FOUND) {
-				if (oclient->summary) {
-					mapidump_message_summary(&obj_message);
-				} else {
-					retval = GetPropsAll(&obj_message, MAPI_UNICODE, &properties_array);
-					if (retval == MAPI_E_SUCCESS) {
-						id = talloc_asprintf(mem_ctx, ": %"PRIX64"/%"PRIX64,
-								     SRowSet.aRow[i].lpProps[0].value.d,
-								     SRowSet.aRow[i].lpProps[1].value.d);
-						mapi_SPropValue_array_named(&obj_message, 
-									    &properties_array);
-						switch (olFolder) {
-						case olFolderInbox:
-						  mapidump_message(&properties_array, id, NULL);
-							break;
-						case olFolderCalendar:
-							mapidump_appointment(&properties_array, id);
-							break;
-						case olFolderContacts:
-							mapidump_contact(&properties_array, id);
-							break;
-						case olFolderTasks:
-							mapidump_task(&properties_array, id);
-							break;
-						case olFolderNotes:
-							mapidump_note(&properties_array, id);
-							break;
-						}
-						talloc_free(id);
-					}
-				}
-				mapi_object_release(&obj_message);
+/*
+ * What the processes fetching with --sessions log on with
+ */
+struct oclient_logon {
+	const char	*profdb;
+	const char	*profname;
+	const char	*password;
+	const char	*username;
+	const char	*debug;
+	bool		dumpdata;
+	uint32_t	profile_cache;
+};
+
+/*
+ * Log on in a worker process and fetch its share of the items
+ */
+static bool openchangeclient_fetchitems_worker(TALLOC_CTX *mem_ctx, const char *item, struct oclient *oclient,
+					       const struct oclient_logon *logon, unsigned int worker)
+{
+	enum MAPISTATUS		retval;
+	struct mapi_session	*session = NULL;
+	mapi_object_t		obj_store;
+	char			*profname;
+	bool			ret;
+
+	retval = MAPIInitialize(&oclient->mapi_ctx, logon->profdb);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MAPIInitialize", GetLastError());
+		return false;
+	}
+
+	SetMAPIProfileCacheTTL(oclient->mapi_ctx, logon->profile_cache);
+	SetMAPIDumpData(oclient->mapi_ctx, logon->dumpdata);
+	if (logon->debug) {
+		SetMAPIDebugLevel(oclient->mapi_ctx, atoi(logon->debug));
+	}
+
+	if (logon->profname) {
+		profname = talloc_strdup(mem_ctx, logon->profname);
+	} else if (GetDefaultProfile(oclient->mapi_ctx, &profname) != MAPI_E_SUCCESS) {
+		mapi_errstr("GetDefaultProfile", GetLastError());
+		return false;
+	}
+
+	retval = MapiLogonEx(oclient->mapi_ctx, &session, profname, logon->password);
+	talloc_free(profname);
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("MapiLogonEx", GetLastError());
+		return false;
+	}
+
+	mapi_object_init(&obj_store);
+	if (oclient->pf == true) {
+		retval = OpenPublicFolder(session, &obj_store);
+	} else if (logon->username) {
+		retval = OpenUserMailbox(session, logon->username, &obj_store);
+	} else {
+		retval = OpenMsgStore(session, &obj_store);
+	}
+	if (retval != MAPI_E_SUCCESS) {
+		mapi_errstr("OpenMsgStore", GetLastError());
+		return false;
+	}
+
+	ret = openchangeclient_fetchitems(mem_ctx, &obj_store, item, oclient, worker, oclient->sessions);
+	mapi_errstr("fetchitems", GetLastError());
+
+	mapi_object_release(&obj_store);
+	MAPIUninitialize(oclient->mapi_ctx);
+	oclient->mapi_ctx = NULL;
+
+	return ret;
+}
+
+/*
+ * Fetch items with several processes, each with its own MAPI session.
+ * Their output is printed in order once they are all done, followed by
+ * the statistics of the whole run.
+ */
+static bool openchangeclient_fetchitems_parallel(TALLOC_CTX *mem_ctx, const char *item,
+						 struct oclient *oclient, const struct oclient_logon *logon)
+{
+	pid_t			*pids;
+	FILE			**outputs;
+	int			*fds;
+	struct oclient_stats	stats;
+	struct oclient_stats	total;
+	char			buf[BUFSIZ];
+	size_t			len;
+	unsigned int		i;
+	int			status;
+	bool			ret = true;
+	double			started = oclient_now();
+
+	pids = talloc_array(mem_ctx, pid_t, oclient->sessions);
+	outputs = talloc_array(mem_ctx, FILE *, oclient->sessions);
+	fds = talloc_array(mem_ctx, int, oclient->sessions * 2);
+	if (!pids || !outputs || !fds) return false;
+
+	fflush(stdout);
+	for (i = 0; i < oclient->sessions; i++) {
+		if ((outputs[i] = tmpfile()) == NULL || pipe(&fds[i * 2]) == -1) {
+			perror("openchangeclient");
+			exit (1);
+		}
+		pids[i] = fork();
+		if (pids[i] == -1) {
+			perror("fork");
+			exit (1);
+		}
+		if (pids[i] == 0) {
+			close(fds[i * 2]);
+			if (dup2(fileno(outputs[i]), STDOUT_FILENO) == -1) {
+				_exit (1);
+			}
+			ret = openchangeclient_fetchitems_worker(mem_ctx, item, oclient, logon, i);
+			fflush(stdout);
+			if (write(fds[i * 2 + 1], &oclient->stats, sizeof (oclient->stats)) != sizeof (oclient->stats)) {
+				ret = false;
 			}
+			_exit(ret ? 0 : 1);
 		}
+		close(fds[i * 2 + 1]);
 	}
-	
-	mapi_object_release(&obj_table);
-	mapi_object_release(&obj_folder);
-	mapi_object_release(&obj_tis);
 
-	return true;
+	memset(&total, 0, sizeof (total));
+	for (i = 0; i < oclient->sessions; i++) {
+		if (read(fds[i * 2], &stats, sizeof (stats)) == sizeof (stats)) {
+			total.messages += stats.messages;
+			total.requests += stats.requests;
+			total.latency += stats.latency;
+			total.latency_max = MAX(total.latency_max, stats.latency_max);
+		}
+		close(fds[i * 2]);
+
+		if (waitpid(pids[i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "[!] session %u failed\n", i);
+			ret = false;
+		}
+
+		rewind(outputs[i]);
+		while ((len = fread(buf, 1, sizeof (buf), outputs[i])) > 0) {
+			fwrite(buf, 1, len, stdout);
+		}
+		fclose(outputs[i]);
+	}
+	fflush(stdout);
+
+	oclient_stats_print(&total, oclient_now() - started);
+
+	talloc_free(fds);
+	talloc_free(outputs);
+	talloc_free(pids);
+
+	return ret;
 }
 
 /**
@@ -2656,6 +2987,134 @@ static bool openchangeclient_ocpf_sender(TALLOC_CTX *mem_ctx, mapi_object_t *obj
 }
 
 
+/**
+ * Expand a --ocpf-var value for a given message: %u is replaced with
+ * the message number
+ */
+static const char *openchangeclient_ocpf_var_value(TALLOC_CTX *mem_ctx, const char *value, uint32_t index)
+{
+	const char	*p;
+
+	p = strstr(value, "%u");
+	if (!p) return value;
+
+	return talloc_asprintf(mem_ctx, "%.*s%u%s", (int)(p - value), value, index, p + 2);
+}
+
+
+/**
+ * Send --ocpf-count messages from a single OCPF file. The file is
+ * parsed and compiled into a template once, each message is a copy of
+ * the template in which the --ocpf-var variables are substituted.
+ */
+static bool openchangeclient_ocpf_sender_count(TALLOC_CTX *mem_ctx, mapi_object_t *obj_store, struct oclient *oclient)
+{
+	enum MAPISTATUS		retval;
+	TALLOC_CTX		*tmp_ctx;
+	struct ocpf_context	*ctx;
+	struct ocpf_template	*tmpl;
+	struct ocpf_var		*var;
+	mapi_object_t		obj_folder;
+	mapi_object_t		obj_message;
+	struct SPropValue	*lpProps;
+	uint32_t		cValues;
+	uint32_t		i;
+	uint32_t		l;
+	uint16_t		propType;
+	const char		*value;
+	bool			ret = false;
+
+	/* Sanity Check */
+	if (!oclient->ocpf_files || !oclient->ocpf_files->next || oclient->ocpf_files->next->next) {
+		errno = MAPI_E_INVALID_PARAMETER;
+		return false;
+	}
+
+	/* Step1. Parse the OCPF file */
+	ctx = ocpf_new_context_r(mem_ctx, oclient->ocpf_files->filename, OCPF_FLAGS_READ);
+	if (!ctx || ocpf_parse_r(ctx) != OCPF_SUCCESS) {
+		if (ctx) ocpf_del_context_r(ctx);
+		errno = MAPI_E_INVALID_PARAMETER;
+		return false;
+	}
+
+	/* Step2. Open destination folder and compile the template */
+	mapi_object_init(&obj_folder);
+	retval = ocpf_OpenFolder_r(ctx, obj_store, &obj_folder);
+	if (retval != MAPI_E_SUCCESS) goto end;
+
+	retval = ocpf_template_compile_r(ctx, &obj_folder, &tmpl);
+	if (retval != MAPI_E_SUCCESS) goto release;
+
+	/* Step3. Check the variables to substitute */
+	for (var = oclient->ocpf_vars; var && var->next; var = var->next) {
+		retval = ocpf_template_get_variable_type(tmpl, var->name, &propType);
+		if (retval != MAPI_E_SUCCESS) {
+			printf("variable %s is not used by any property\n", var->name);
+			goto release;
+		}
+		if (propType != PT_UNICODE && propType != PT_LONG) {
+			printf("variable %s: only string and long variables can be substituted\n", var->name);
+			errno = MAPI_E_INVALID_PARAMETER;
+			goto release;
+		}
+	}
+
+	/* Step4. Create the messages */
+	for (i = 0; i < oclient->ocpf_count; i++) {
+		tmp_ctx = talloc_new(mem_ctx);
+		lpProps = ocpf_template_instantiate(tmp_ctx, tmpl, &cValues);
+		if (!lpProps) {
+			talloc_free(tmp_ctx);
+			errno = MAPI_E_NOT_ENOUGH_MEMORY;
+			goto release;
+		}
+
+		for (var = oclient->ocpf_vars; var && var->next; var = var->next) {
+			ocpf_template_get_variable_type(tmpl, var->name, &propType);
+			value = openchangeclient_ocpf_var_value(tmp_ctx, var->value, i);
+			if (propType == PT_LONG) {
+				l = strtoul(value, NULL, 0);
+				ocpf_template_set_variable(tmpl, lpProps, var->name, &l);
+			} else {
+				ocpf_template_set_variable(tmpl, lpProps, var->name, value);
+			}
+		}
+
+		mapi_object_init(&obj_message);
+		retval = CreateMessage(&obj_folder, &obj_message);
+		if (retval != MAPI_E_SUCCESS) {
+			talloc_free(tmp_ctx);
+			goto release;
+		}
+
+		retval = ocpf_template_set_Recipients(tmpl, &obj_message);
+		if (retval != MAPI_E_SUCCESS && GetLastError() != MAPI_E_NOT_FOUND) {
+			mapi_object_release(&obj_message);
+			talloc_free(tmp_ctx);
+			goto release;
+		}
+		errno = MAPI_E_SUCCESS;
+
+		retval = SetProps(&obj_message, MAPI_PROPS_SKIP_NAMEDID_CHECK, lpProps, cValues);
+		if (retval == MAPI_E_SUCCESS) {
+			retval = SaveChangesMessage(&obj_folder, &obj_message, KeepOpenReadOnly);
+		}
+		mapi_object_release(&obj_message);
+		talloc_free(tmp_ctx);
+		if (retval != MAPI_E_SUCCESS) goto release;
+	}
+	ret = true;
+
+release:
+	mapi_object_release(&obj_folder);
+end:
+	ocpf_del_context_r(ctx);
+
+	return ret;
+}
+
+
 static bool openchangeclient_ocpf_dump(TALLOC_CTX *mem_ctx, mapi_object_t *obj_store, struct oclient *oclient)
 {
 	enum MAPISTATUS			retval;
@@ -2862,6 +3321,7 @@ int main(int argc, const char *argv[])
 	const char		*opt_mapi_cc = NULL;
 	const char		*opt_mapi_bcc = NULL;
 	const char		*opt_debug = NULL;
+	uint32_t		opt_profile_cache = 0;
 
 	enum {OPT_PROFILE_DB=1000, OPT_PROFILE, OPT_SENDMAIL, OPT_PASSWORD, OPT_SENDAPPOINTMENT, 
 	      OPT_SENDCONTACT, OPT_SENDTASK, OPT_FETCHMAIL, OPT_STOREMAIL,  OPT_DELETEMAIL, 
@@ -2875,7 +3335,8 @@ int main(int argc, const char *argv[])
 	      OPT_FOLDER_NAME, OPT_FOLDER_COMMENT, OPT_USERLIST, OPT_MAPI_PRIVATE,
 	      OPT_UPDATE, OPT_DELETEITEMS, OPT_OCPF_FILE, OPT_OCPF_SYNTAX,
 	      OPT_OCPF_SENDER, OPT_OCPF_DUMP, OPT_FREEBUSY, OPT_FORCE, OPT_FETCHSUMMARY,
-	      OPT_USERNAME };
+	      OPT_USERNAME, OPT_OCPF_COUNT, OPT_OCPF_VAR, OPT_PROFILE_CACHE,
+	      OPT_BATCH, OPT_ICS, OPT_SESSIONS };
 
 	struct poptOption long_options[] = {
 		POPT_AUTOHELP
@@ -2891,6 +3352,9 @@ int main(int argc, const char *argv[])
 		{"sendnote", 0, POPT_ARG_NONE, NULL, OPT_SENDNOTE, "send a note", NULL },
 		{"fetchmail", 'F', POPT_ARG_NONE, NULL, OPT_FETCHMAIL, "fetch user INBOX mails", NULL },
 		{"fetchsummary", 0, POPT_ARG_NONE, NULL, OPT_FETCHSUMMARY, "fetch message summaries only", NULL },
+		{"batch", 0, POPT_ARG_STRING, NULL, OPT_BATCH, "open COUNT messages per request with --fetch-items", "COUNT" },
+		{"ics", 0, POPT_ARG_NONE, NULL, OPT_ICS, "list --fetch-items messages with an ICS synchronization", NULL },
+		{"sessions", 0, POPT_ARG_STRING, NULL, OPT_SESSIONS, "fetch --fetch-items messages with COUNT sessions in parallel", "COUNT" },
 		{"storemail", 'G', POPT_ARG_STRING, NULL, OPT_STOREMAIL, "retrieve a mail on the filesystem", NULL },
 		{"fetch-items", 'i', POPT_ARG_STRING, NULL, OPT_FETCHITEMS, "fetch specified user INBOX items", NULL },
 		{"freebusy", 0, POPT_ARG_STRING, NULL, OPT_FREEBUSY, "display free / busy information for the specified user", NULL },
@@ -2932,6 +3396,9 @@ int main(int argc, const char *argv[])
 		{"ocpf-dump", 0, POPT_ARG_STRING, NULL, OPT_OCPF_DUMP, "dump message into OCPF file", NULL },
 		{"ocpf-syntax", 0, POPT_ARG_NONE, NULL, OPT_OCPF_SYNTAX, "check OCPF files syntax", NULL },
 		{"ocpf-sender", 0, POPT_ARG_NONE, NULL, OPT_OCPF_SENDER, "send message using OCPF files contents", NULL },
+		{"ocpf-count", 0, POPT_ARG_STRING, NULL, OPT_OCPF_COUNT, "send COUNT messages from a compiled OCPF file", "COUNT" },
+		{"ocpf-var", 0, POPT_ARG_STRING, NULL, OPT_OCPF_VAR, "substitute an OCPF variable in --ocpf-count messages", "NAME=VALUE" },
+		{"profile-cache", 0, POPT_ARG_STRING, NULL, OPT_PROFILE_CACHE, "cache profiles and resolved servers for SECONDS", "SECONDS" },
 		POPT_OPENCHANGE_VERSION
 		{NULL, 0, 0, NULL, 0, NULL, NULL}
 	};
@@ -3120,6 +3587,45 @@ int main(int argc, const char *argv[])
 		case OPT_OCPF_DUMP:
 			oclient.ocpf_dump = poptGetOptArg(pc);
 			break;
+		case OPT_OCPF_COUNT:
+			oclient.ocpf_count = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_OCPF_VAR:
+		{
+			struct ocpf_var		*element;
+			char			*arg;
+			char			*sep;
+
+			arg = talloc_strdup(mem_ctx, poptGetOptArg(pc));
+			sep = strchr(arg, '=');
+			if (!sep) {
+				printf("--ocpf-var expects NAME=VALUE\n");
+				exit (1);
+			}
+			*sep = '\0';
+
+			if (!oclient.ocpf_vars) {
+				oclient.ocpf_vars = talloc_zero(mem_ctx, struct ocpf_var);
+			}
+
+			element = talloc_zero(mem_ctx, struct ocpf_var);
+			element->name = arg;
+			element->value = sep + 1;
+			DLIST_ADD(oclient.ocpf_vars, element);
+			break;
+		}
+		case OPT_PROFILE_CACHE:
+			opt_profile_cache = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_BATCH:
+			oclient.batch = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
+		case OPT_ICS:
+			oclient.ics = true;
+			break;
+		case OPT_SESSIONS:
+			oclient.sessions = strtoul(poptGetOptArg(pc), NULL, 10);
+			break;
 		case OPT_FORCE:
 			oclient.force = true;
 			break;
@@ -3179,6 +3685,11 @@ int main(int argc, const char *argv[])
 		exit (1);
 	}
 
+	if (!oclient.sessions) {
+		printf("--sessions expects at least one session\n");
+		exit (1);
+	}
+
 	/* One of the rare options which doesn't require MAPI to get
 	 *   initialized 
 	 */
@@ -3191,6 +3702,24 @@ int main(int argc, const char *argv[])
 		exit (0);
 	}
 	
+	/* Each process logs on itself, the other operations are done
+	 * afterwards */
+	if (opt_fetchitems && oclient.sessions > 1) {
+		struct oclient_logon	logon;
+
+		logon.profdb = opt_profdb;
+		logon.profname = opt_profname;
+		logon.password = opt_password;
+		logon.username = opt_username;
+		logon.debug = opt_debug;
+		logon.dumpdata = opt_dumpdata;
+		logon.profile_cache = opt_profile_cache;
+		if (openchangeclient_fetchitems_parallel(mem_ctx, opt_fetchitems, &oclient, &logon) != true) {
+			exit (1);
+		}
+		opt_fetchitems = NULL;
+	}
+
 	/**
 	 * Initialize MAPI subsystem
 	 */
@@ -3201,6 +3730,8 @@ int main(int argc, const char *argv[])
 		exit (1);
 	}
 
+	SetMAPIProfileCacheTTL(oclient.mapi_ctx, opt_profile_cache);
+
 	/* debug options */
 	SetMAPIDumpData(oclient.mapi_ctx, opt_dumpdata);
 
@@ -3267,7 +3798,13 @@ int main(int argc, const char *argv[])
 	 * OCPF sending command
 	 */
 	if (opt_ocpf_sender) {
-		bool ret = openchangeclient_ocpf_sender(mem_ctx, &obj_store, &oclient);
+		bool ret;
+
+		if (oclient.ocpf_count) {
+			ret = openchangeclient_ocpf_sender_count(mem_ctx, &obj_store, &oclient);
+		} else {
+			ret = openchangeclient_ocpf_sender(mem_ctx, &obj_store, &oclient);
+		}
 		mapi_errstr("OCPF Sender", GetLastError());
 		if (ret != true) {
 			goto end;
@@ -3283,7 +3820,7 @@ int main(int argc, const char *argv[])
 	}
 
 	if (opt_fetchitems) {
-		bool ret = openchangeclient_fetchitems(mem_ctx, &obj_store, opt_fetchitems, &oclient);
+		bool ret = openchangeclient_fetchitems(mem_ctx, &obj_store, opt_fetchitems, &oclient, 0, 1);
 		mapi_errstr("fetchitems", GetLastError());
 		if (ret != true) {
 			goto end;
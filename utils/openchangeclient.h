@@ -36,12 +36,26 @@ struct ocpf_file {
 	const char		*filename;
 };
 
+struct ocpf_var {
+	struct ocpf_var		*prev;
+	struct ocpf_var		*next;
+	const char		*name;
+	const char		*value;
+};
+
 struct attach {
 	const char		*filename;
 	struct Binary_r		bin;
 	int			fd;
 };
 
+struct oclient_stats {
+	uint32_t		messages;
+	uint32_t		requests;
+	double			latency;	/* seconds waiting for the server */
+	double			latency_max;
+};
+
 struct oclient {
 	struct mapi_context	*mapi_ctx;
 	struct oc_property	*props;
@@ -83,6 +97,13 @@ struct oclient {
 	/* OCPF related options */
 	struct ocpf_file	*ocpf_files;
 	const char		*ocpf_dump;
+	uint32_t		ocpf_count;
+	struct ocpf_var		*ocpf_vars;
+	/* Bulk fetch options */
+	uint32_t		batch;
+	bool			ics;
+	uint32_t		sessions;
+	struct oclient_stats	stats;
 };
 
 struct itemfolder {
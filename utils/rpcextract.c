@@ -192,8 +192,9 @@ static const char *GetNspiOpStr(short opnum)
 }
 
 
-static void rip_file(int packet_num, char packet_type, char *proto, u_char *tcp)
+static void rip_file(int packet_num, char packet_type, char *proto, u_char *tcp, const struct timeval *ts)
 {
+	struct timeval		times[2];
 	short			*opnum;
 	u_int			*alloch;
 	const char		*opstr = NULL;
@@ -227,6 +228,13 @@ static void rip_file(int packet_num, char packet_type, char *proto, u_char *tcp)
 	write(fd, (char *)(tcp + sizeof(struct tcphdr) + LEN2ALLOCH + 8), *alloch);
 	close(fd);
 
+	/* Keep the capture time of the packet, ocreplay uses it to
+	   replay the original timing */
+	times[0] = times[1] = *ts;
+	if (utimes(filename, times) < 0) {
+		perror("utimes");
+	}
+
 	if (destdir) {
 		chdir(olddir);
 	}
@@ -332,7 +340,7 @@ static void extr_cb(u_char *param, const struct pcap_pkthdr *header, const u_cha
 			if (FLWD_TSTRM && (seek_port(&bport, dst_port, src_port) == 1) && PKT_GOT_DATA) {
 				packet_type = (char *)((char *)packet_tcp + sizeof(struct tcphdr) + 2);
 				if ((*packet_type == RPC_REQ) || (*packet_type == RPC_RESP))
-					rip_file(i - 1, *packet_type, bport->proto, (u_char *)packet_tcp);
+					rip_file(i - 1, *packet_type, bport->proto, (u_char *)packet_tcp, &header->ts);
 			}
 		}
 		if ((endp_bind) && FLWD_TSTRM && FLWD_DPORT) {